@@ -0,0 +1,70 @@
+#!/bin/sh
+# Runs the set benchmark matrix and appends one row per run to a
+# CSV (or JSON lines) file.
+#
+# The set profiler talks to the set service of a running peer, so
+# start the peer first (gnunet-arm -s -c CFG).  The matrix can be
+# narrowed down with environment variables, for example
+#   SIZES="1000 10000" RATIOS="0.01" ./set-profiler-matrix.sh -c peer.conf
+#
+# SIZES          total number of elements per set
+# RATIOS         fraction of each set that is not in the other set
+# ELEMENT_SIZES  element sizes in bytes
+# OPERATIONS     "union" and/or "intersection"
+# IBF_FACTORS    IBF size as a multiple of the difference (ibf profiler)
+# HASH_NUMS      number of IBF hash functions (ibf profiler)
+# SEED           seed for generating the elements
+
+SIZES=${SIZES:-"1000 10000 100000 1000000 10000000"}
+RATIOS=${RATIOS:-"0.001 0.01 0.1"}
+ELEMENT_SIZES=${ELEMENT_SIZES:-"64 256 1024"}
+OPERATIONS=${OPERATIONS:-"union intersection"}
+IBF_FACTORS=${IBF_FACTORS:-"1.5 2 3"}
+HASH_NUMS=${HASH_NUMS:-"3 4"}
+SEED=${SEED:-42}
+PROFILER=${PROFILER:-gnunet-set-profiler}
+IBF_PROFILER=${IBF_PROFILER:-gnunet-set-ibf-profiler}
+
+CFG=""
+FORMAT=csv
+OUT=set-profiler.csv
+IBF_OUT=set-ibf-profiler.csv
+
+usage ()
+{
+  echo "Usage: $0 [-c CONFIG] [-f csv|json] [-o SET_OUTPUT] [-i IBF_OUTPUT]"
+  exit 1
+}
+
+while getopts "c:f:o:i:h" opt; do
+  case $opt in
+    c) CFG="-c $OPTARG" ;;
+    f) FORMAT=$OPTARG ;;
+    o) OUT=$OPTARG ;;
+    i) IBF_OUT=$OPTARG ;;
+    *) usage ;;
+  esac
+done
+
+for size in $SIZES; do
+  for ratio in $RATIOS; do
+    # elements only in A resp. only in B, the rest is common
+    diff=`awk "BEGIN { d = int ($size * $ratio / 2); if (d < 1) d = 1; print d }"`
+    common=`expr $size - $diff`
+    for op in $OPERATIONS; do
+      for esize in $ELEMENT_SIZES; do
+        echo "$op: size $size, ratio $ratio, element size $esize" >&2
+        $PROFILER $CFG -x $op -A $diff -B $diff -C $common \
+          -e $esize -s $SEED -f $FORMAT -o $OUT \
+          || echo "$op run failed: size $size, ratio $ratio, element size $esize" >&2
+      done
+    done
+    for k in $HASH_NUMS; do
+      for factor in $IBF_FACTORS; do
+        ibf_size=`awk "BEGIN { s = int (2 * $diff * $factor); if (s < 1) s = 1; print s }"`
+        $IBF_PROFILER -A $diff -B $diff -C $common -k $k -s $ibf_size \
+          -f $FORMAT -o $IBF_OUT
+      done
+    done
+  done
+done
@@ -27,6 +27,7 @@
 #include "gnunet_util_lib.h"
 #include "gnunet_arm_service.h"
 #include "gnunet_protocols.h"
+#include "gnunet_statistics_service.h"
 #include "arm.h"
 
 /**
@@ -170,6 +171,18 @@ struct ServiceList
    * are on Windoze).
    */
   int pipe_control;
+
+  /**
+   * Should we keep a preforked process of this on-demand service waiting
+   * for the first connection to its listen sockets?  (PREFORK option)
+   */
+  int prefork;
+
+  /**
+   * #GNUNET_YES if @e proc is a preforked process which has not been
+   * activated yet.
+   */
+  int parked;
 };
 
 /**
@@ -197,6 +210,12 @@ static char *prefix_command;
  */
 static char *final_option;
 
+/**
+ * Pre-parsed configuration for our children, NULL if we did
+ * not write one.
+ */
+static char *config_snapshot;
+
 /**
  * ID of task called whenever we get a SIGCHILD.
  */
@@ -245,6 +264,11 @@ static struct GNUNET_SERVER_Handle *server;
  */
 static struct GNUNET_SERVER_NotificationContext *notifier;
 
+/**
+ * Handle for reporting statistics.
+ */
+static struct GNUNET_STATISTICS_Handle *stats;
+
 
 /**
  * Transmit a status result message.
@@ -388,18 +412,19 @@ broadcast_status (const char *name,
 
 
 /**
- * Actually start the process for the given service.
+ * Fork and exec the process for the given service.
  *
  * @param sl identifies service to start
- * @param client that asked to start the service (may be NULL)
- * @param request_id id of the request in response to which the process is
- *                   being started. 0 if starting was not requested.
+ * @param park #GNUNET_YES to prefork the process; it then waits for its
+ *             activation and we keep watching the listen sockets
+ * @return the process, NULL on error
  */
-static void
-start_process (struct ServiceList *sl,
-               struct GNUNET_SERVER_Client *client,
-               uint64_t request_id)
+static struct GNUNET_OS_Process *
+spawn_process (struct ServiceList *sl,
+               int park)
 {
+  struct GNUNET_OS_Process *proc;
+  int pipe_control;
   char *loprefix;
   char *options;
   char *optpos;
@@ -421,6 +446,8 @@ start_process (struct ServiceList *sl,
     {
       GNUNET_array_append (lsocks, ls,
 			   GNUNET_NETWORK_get_fd (sli->listen_socket));
+      if (GNUNET_YES == park)
+        continue;
       if (sli->accept_task != NULL)
 	{
 	  GNUNET_SCHEDULER_cancel (sli->accept_task);
@@ -489,18 +516,21 @@ start_process (struct ServiceList *sl,
 		   "\"%s\"",
 		   binary);
 
-  GNUNET_assert (NULL == sl->proc);
+  /* a preforked process is activated through its control pipe */
+  pipe_control = (GNUNET_YES == park) ? GNUNET_YES : sl->pipe_control;
+  if (GNUNET_YES == park)
+    setenv (GNUNET_SERVICE_PREFORK_ENV, "YES", 1);
   if (GNUNET_YES == use_debug)
   {
     if (NULL == sl->config)
-      sl->proc =
-	GNUNET_OS_start_process_s (sl->pipe_control,
+      proc =
+	GNUNET_OS_start_process_s (pipe_control,
                                    GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
                                    lsocks, loprefix, quotedbinary, "-L",
                                    "DEBUG", options, NULL);
     else
-      sl->proc =
-          GNUNET_OS_start_process_s (sl->pipe_control,
+      proc =
+          GNUNET_OS_start_process_s (pipe_control,
                                      GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
                                      lsocks, loprefix, quotedbinary, "-c",
                                      sl->config, "-L",
@@ -509,21 +539,117 @@ start_process (struct ServiceList *sl,
   else
   {
     if (NULL == sl->config)
-      sl->proc =
-          GNUNET_OS_start_process_s (sl->pipe_control,
+      proc =
+          GNUNET_OS_start_process_s (pipe_control,
                                      GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
                                      lsocks, loprefix, quotedbinary,
                                      options, NULL);
     else
-      sl->proc =
-          GNUNET_OS_start_process_s (sl->pipe_control,
+      proc =
+          GNUNET_OS_start_process_s (pipe_control,
                                      GNUNET_OS_INHERIT_STD_OUT_AND_ERR,
                                      lsocks, loprefix, quotedbinary, "-c",
                                      sl->config, options, NULL);
   }
+  if (GNUNET_YES == park)
+    unsetenv (GNUNET_SERVICE_PREFORK_ENV);
   GNUNET_free (binary);
   GNUNET_free (quotedbinary);
-  if (sl->proc == NULL)
+  GNUNET_free (loprefix);
+  GNUNET_free (options);
+  GNUNET_array_grow (lsocks, ls, 0);
+  return proc;
+}
+
+
+/**
+ * Record how long it took to start the given service.
+ *
+ * @param sl the service which was started
+ * @param start_time when we were asked to start it
+ */
+static void
+record_startup (struct ServiceList *sl,
+                struct GNUNET_TIME_Absolute start_time)
+{
+  char *name;
+
+  if (NULL == stats)
+    return;
+  GNUNET_STATISTICS_update (stats,
+                            (GNUNET_YES == sl->parked)
+                            ? gettext_noop ("# services activated from prefork")
+                            : gettext_noop ("# services started"),
+                            1, GNUNET_NO);
+  GNUNET_asprintf (&name,
+                   "# startup time of `%s' (us)",
+                   sl->name);
+  GNUNET_STATISTICS_observe (stats, name,
+                             GNUNET_TIME_absolute_get_duration (start_time).rel_value_us,
+                             GNUNET_NO);
+  GNUNET_free (name);
+}
+
+
+/**
+ * Activate the preforked process of the given service.
+ *
+ * @param sl identifies service to activate
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if we could not reach the
+ *         process (it is then killed)
+ */
+static int
+activate_process (struct ServiceList *sl)
+{
+  struct ServiceListeningInfo *sli;
+
+  for (sli = sl->listen_head; NULL != sli; sli = sli->next)
+    if (NULL != sli->accept_task)
+    {
+      GNUNET_SCHEDULER_cancel (sli->accept_task);
+      sli->accept_task = NULL;
+    }
+  if (0 == GNUNET_OS_process_kill (sl->proc, SIGCONT))
+    return GNUNET_OK;
+  GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "kill");
+  /* the dead process is collected by maint_child_death() */
+  (void) GNUNET_OS_process_kill (sl->proc, SIGKILL);
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Actually start the process for the given service.  If we have a
+ * preforked process for it, that process is activated instead.
+ *
+ * @param sl identifies service to start
+ * @param client that asked to start the service (may be NULL)
+ * @param request_id id of the request in response to which the process is
+ *                   being started. 0 if starting was not requested.
+ */
+static void
+start_process (struct ServiceList *sl,
+               struct GNUNET_SERVER_Client *client,
+               uint64_t request_id)
+{
+  struct GNUNET_TIME_Absolute start_time;
+  int ok;
+
+  start_time = GNUNET_TIME_absolute_get ();
+  if (GNUNET_YES == sl->parked)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Activating preforked process of service `%s'\n",
+                sl->name);
+    ok = activate_process (sl);
+  }
+  else
+  {
+    GNUNET_assert (NULL == sl->proc);
+    sl->proc = spawn_process (sl, GNUNET_NO);
+    ok = (NULL == sl->proc) ? GNUNET_SYSERR : GNUNET_OK;
+  }
+  if (GNUNET_OK != ok)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 _("Failed to start service `%s'\n"),
@@ -539,14 +665,43 @@ start_process (struct ServiceList *sl,
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                 _("Starting service `%s'\n"),
 		sl->name);
+    record_startup (sl, start_time);
     broadcast_status (sl->name, GNUNET_ARM_SERVICE_STARTING, NULL);
     if (client)
       signal_result (client, sl->name, request_id, GNUNET_ARM_RESULT_STARTING);
   }
-  /* clean up */
-  GNUNET_free (loprefix);
-  GNUNET_free (options);
-  GNUNET_array_grow (lsocks, ls, 0);
+  sl->parked = GNUNET_NO;
+}
+
+
+/**
+ * Prefork the process of an on-demand service, so that the first
+ * connection to it does not have to wait for the process to be
+ * executed and to load its configuration.
+ *
+ * @param sl identifies service to prefork
+ */
+static void
+prefork_process (struct ServiceList *sl)
+{
+  if ((GNUNET_YES != sl->prefork) ||
+      (GNUNET_YES == sl->force_start) ||
+      (GNUNET_YES == in_shutdown) ||
+      (NULL != sl->proc) ||
+      (NULL == sl->listen_head))
+    return;
+  sl->proc = spawn_process (sl, GNUNET_YES);
+  if (NULL == sl->proc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to prefork service `%s'\n"),
+		sl->name);
+    return;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Preforked service `%s'\n",
+              sl->name);
+  sl->parked = GNUNET_YES;
 }
 
 
@@ -777,7 +932,8 @@ handle_start (void *cls,
     return;
   }
   sl->force_start = GNUNET_YES;
-  if (NULL != sl->proc)
+  if ((NULL != sl->proc) &&
+      (GNUNET_YES != sl->parked))
   {
     signal_result (client, servicename, request_id,
 		   GNUNET_ARM_RESULT_IS_STARTED_ALREADY);
@@ -922,7 +1078,7 @@ handle_list (void *cls, struct GNUNET_SERVER_Client *client,
   /* first count the running processes get their name's size */
   for (sl = running_head; NULL != sl; sl = sl->next)
   {
-    if (NULL != sl->proc)
+    if ((NULL != sl->proc) && (GNUNET_YES != sl->parked))
     {
       string_list_size += strlen (sl->name);
       string_list_size += strlen (sl->binary);
@@ -943,7 +1099,7 @@ handle_list (void *cls, struct GNUNET_SERVER_Client *client,
   char *pos = (char *)&msg[1];
   for (sl = running_head; NULL != sl; sl = sl->next)
   {
-    if (NULL != sl->proc)
+    if ((NULL != sl->proc) && (GNUNET_YES != sl->parked))
     {
       size_t s = strlen (sl->name) + strlen (sl->binary) + 4;
       GNUNET_snprintf (pos, s, "%s (%s)", sl->name, sl->binary);
@@ -966,6 +1122,15 @@ static void
 do_shutdown ()
 {
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Last shutdown phase\n");
+  if (NULL != config_snapshot)
+  {
+    if (0 != UNLINK (config_snapshot))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                config_snapshot);
+    GNUNET_free (config_snapshot);
+    config_snapshot = NULL;
+  }
   if (NULL != notifier)
   {
     GNUNET_SERVER_notification_context_destroy (notifier);
@@ -1004,6 +1169,45 @@ list_count (struct ServiceList *running_head)
 }
 
 
+/**
+ * Write a pre-parsed snapshot of our configuration file and tell
+ * our children about it, so that they do not have to parse all
+ * the configuration files again.
+ */
+static void
+write_config_snapshot ()
+{
+  char *filename;
+
+  if (GNUNET_NO ==
+      GNUNET_CONFIGURATION_get_value_yesno (cfg, "ARM", "CONFIG_SNAPSHOT"))
+    return;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg, "PATHS", "DEFAULTCONFIG",
+                                               &filename))
+    return;
+  config_snapshot = GNUNET_DISK_mktemp ("gnunet-arm-config");
+  if ( (NULL == config_snapshot) ||
+       (GNUNET_OK !=
+        GNUNET_CONFIGURATION_snapshot_write (config_snapshot, filename)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to write configuration snapshot for `%s'\n"),
+                filename);
+    if (NULL != config_snapshot)
+    {
+      (void) UNLINK (config_snapshot);
+      GNUNET_free (config_snapshot);
+      config_snapshot = NULL;
+    }
+    GNUNET_free (filename);
+    return;
+  }
+  GNUNET_free (filename);
+  setenv (GNUNET_CONFIGURATION_SNAPSHOT_ENV, config_snapshot, 1);
+}
+
+
 /**
  * Task run for shutdown.
  *
@@ -1026,6 +1230,11 @@ shutdown_task (void *cls,
     child_restart_task = NULL;
   }
   in_shutdown = GNUNET_YES;
+  if (NULL != stats)
+  {
+    GNUNET_STATISTICS_destroy (stats, GNUNET_NO);
+    stats = NULL;
+  }
   /* first, stop listening */
   for (pos = running_head; NULL != pos; pos = pos->next)
   {
@@ -1123,6 +1332,7 @@ delayed_restart_task (void *cls,
 	      (GNUNET_TIME_UNIT_FOREVER_REL, sli->listen_socket,
 	       &accept_connection, sli);
 	  }
+	prefork_process (sl);
       }
     }
     else
@@ -1167,6 +1377,7 @@ maint_child_death (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   enum GNUNET_OS_ProcessStatusType statusType;
   unsigned long statusCode;
   const struct GNUNET_DISK_FileHandle *pr;
+  int was_parked;
 
   pr = GNUNET_DISK_pipe_handle (sigpipe, GNUNET_DISK_PIPE_END_READ);
   child_death_task = NULL;
@@ -1223,6 +1434,18 @@ maint_child_death (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
       }
       GNUNET_OS_process_destroy (pos->proc);
       pos->proc = NULL;
+      was_parked = pos->parked;
+      if (GNUNET_YES == was_parked)
+      {
+        /* we were still watching the listen sockets for it */
+        pos->parked = GNUNET_NO;
+        for (sli = pos->listen_head; NULL != sli; sli = sli->next)
+          if (NULL != sli->accept_task)
+          {
+            GNUNET_SCHEDULER_cancel (sli->accept_task);
+            sli->accept_task = NULL;
+          }
+      }
       broadcast_status (pos->name, GNUNET_ARM_SERVICE_STOPPED, NULL);
       if (NULL != pos->killing_client)
       {
@@ -1249,6 +1472,9 @@ maint_child_death (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
                 GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
                     sli->listen_socket, &accept_connection, sli);
           }
+          /* a preforked process which exits by itself is not forked again */
+          if (GNUNET_YES != was_parked)
+            prefork_process (pos);
 	}
         else
         {
@@ -1389,6 +1615,7 @@ setup_service (void *cls,
 #else
   if (GNUNET_CONFIGURATION_have_value (cfg, section, "PIPECONTROL"))
     sl->pipe_control = GNUNET_CONFIGURATION_get_value_yesno (cfg, section, "PIPECONTROL");
+  sl->prefork = GNUNET_CONFIGURATION_get_value_yesno (cfg, section, "PREFORK");
 #endif
   GNUNET_CONTAINER_DLL_insert (running_head,
                                running_tail,
@@ -1522,12 +1749,16 @@ run (void *cls, struct GNUNET_SERVER_Handle *serv,
     GNUNET_break (GNUNET_YES == start_system);
     start_user = GNUNET_NO;
   }
+  stats = GNUNET_STATISTICS_create ("arm", cfg);
   GNUNET_CONFIGURATION_iterate_sections (cfg, &setup_service, NULL);
+  write_config_snapshot ();
 
-  /* start default services... */
+  /* start default services, prefork on-demand ones... */
   for (sl = running_head; NULL != sl; sl = sl->next)
     if (GNUNET_YES == sl->force_start)
       start_process (sl, NULL, 0);
+    else
+      prefork_process (sl);
   notifier
     = GNUNET_SERVER_notification_context_create (server,
                                                  MAX_NOTIFY_QUEUE);
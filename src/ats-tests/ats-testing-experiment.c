@@ -39,6 +39,8 @@ print_op (enum OperationType op)
       return "START_PREFERENCE";
     case STOP_PREFERENCE:
       return "STOP_PREFERENCE";
+    case SET_LINK:
+      return "SET_LINK";
     default:
       break;
   }
@@ -87,6 +89,70 @@ free_experiment (struct Experiment *e)
 }
 
 
+/**
+ * Load the link characteristics of a set_link operation.  All
+ * values apply to both directions of the link.
+ *
+ * @param o the operation
+ * @param cfg the experiment configuration
+ * @param sec_name section of the episode
+ * @param op_counter index of the operation in the episode
+ * @return #GNUNET_OK on success
+ */
+static int
+load_link (struct GNUNET_ATS_TEST_Operation *o,
+           struct GNUNET_CONFIGURATION_Handle *cfg,
+           const char *sec_name,
+           int op_counter)
+{
+  struct GNUNET_TRANSPORT_EmulationParameters *ep = &o->link;
+  unsigned long long bw;
+  float loss;
+  char *op_name;
+  int ret;
+
+  ret = GNUNET_OK;
+  GNUNET_asprintf (&op_name, "op-%u-delay", op_counter);
+  if (GNUNET_OK == GNUNET_CONFIGURATION_get_value_time (cfg,
+      sec_name, op_name, &ep->delay_out))
+    ep->delay_in = ep->delay_out;
+  GNUNET_free (op_name);
+  GNUNET_asprintf (&op_name, "op-%u-jitter", op_counter);
+  if (GNUNET_OK == GNUNET_CONFIGURATION_get_value_time (cfg,
+      sec_name, op_name, &ep->jitter_out))
+    ep->jitter_in = ep->jitter_out;
+  GNUNET_free (op_name);
+  GNUNET_asprintf (&op_name, "op-%u-bandwidth", op_counter);
+  if (GNUNET_OK == GNUNET_CONFIGURATION_get_value_size (cfg,
+      sec_name, op_name, &bw))
+  {
+    if (bw > UINT32_MAX)
+      ret = GNUNET_SYSERR;
+    ep->bandwidth_in = ep->bandwidth_out = (uint32_t) bw;
+  }
+  GNUNET_free (op_name);
+  GNUNET_asprintf (&op_name, "op-%u-loss", op_counter);
+  if (GNUNET_OK == GNUNET_CONFIGURATION_get_value_float (cfg,
+      sec_name, op_name, &loss))
+  {
+    if ((loss < 0.0) || (loss > 100.0))
+      ret = GNUNET_SYSERR;
+    ep->loss_in = ep->loss_out = (uint32_t) (loss * 10000.0 + 0.5);
+  }
+  GNUNET_free (op_name);
+  GNUNET_asprintf (&op_name, "op-%u-reorder", op_counter);
+  ep->reorder = GNUNET_CONFIGURATION_get_value_yesno (cfg,
+      sec_name, op_name);
+  if (GNUNET_SYSERR == ep->reorder)
+    ep->reorder = GNUNET_NO;
+  GNUNET_free (op_name);
+  if (GNUNET_OK != ret)
+    fprintf (stderr, "Invalid link in operation %u in episode %s\n",
+        op_counter, sec_name);
+  return ret;
+}
+
+
 static int
 load_episode (struct Experiment *e,
               struct Episode *cur,
@@ -114,7 +180,8 @@ load_episode (struct Experiment *e,
       break;
     }
     o = GNUNET_new (struct GNUNET_ATS_TEST_Operation);
-    /* operations = set_rate, start_send, stop_send, set_preference */
+    /* operations = start_send, stop_send, start_preference,
+       stop_preference, set_link */
     if (0 == strcmp (op, "start_send"))
     {
       o->type = START_SEND;
@@ -131,6 +198,10 @@ load_episode (struct Experiment *e,
     {
       o->type = STOP_PREFERENCE;
     }
+    else if (0 == strcmp (op, "set_link"))
+    {
+      o->type = SET_LINK;
+    }
     else
     {
       fprintf (stderr, "Invalid operation %u `%s' in episode %u\n",
@@ -330,6 +401,16 @@ load_episode (struct Experiment *e,
       }
     }
 
+    if ( (SET_LINK == o->type) &&
+         (GNUNET_OK != load_link (o, cfg, sec_name, op_counter)) )
+    {
+      GNUNET_free_non_null (type);
+      GNUNET_free (op);
+      GNUNET_free (o);
+      GNUNET_free (sec_name);
+      return GNUNET_SYSERR;
+    }
+
     /* Safety checks */
     if ((GNUNET_ATS_TEST_TG_LINEAR == o->gen_type) ||
         (GNUNET_ATS_TEST_TG_SINUS == o->gen_type))
@@ -547,6 +628,37 @@ enforce_stop_preference (struct GNUNET_ATS_TEST_Operation *op)
   }
 }
 
+static void
+enforce_set_link (struct GNUNET_ATS_TEST_Operation *op)
+{
+  struct BenchmarkPeer *peer;
+  struct BenchmarkPartner *partner;
+
+  peer = GNUNET_ATS_TEST_get_peer (op->src_id);
+  if (NULL == peer)
+  {
+    GNUNET_break (0);
+    return;
+  }
+
+  partner = GNUNET_ATS_TEST_get_partner (op->src_id, op->dest_id);
+  if (NULL == partner)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  if (NULL == peer->th)
+  {
+    fprintf (stderr, "Cannot emulate link without transport connection\n");
+    return;
+  }
+
+  fprintf (stderr, "Emulating link between master %llu slave %llu\n",
+      op->src_id, op->dest_id);
+  GNUNET_TRANSPORT_set_traffic_emulation (peer->th, &partner->dest->id,
+      &op->link);
+}
+
 static void enforce_episode (struct Episode *ep)
 {
   struct GNUNET_ATS_TEST_Operation *cur;
@@ -568,6 +680,9 @@ static void enforce_episode (struct Episode *ep)
       case STOP_PREFERENCE:
         enforce_stop_preference (cur);
         break;
+      case SET_LINK:
+        enforce_set_link (cur);
+        break;
       default:
         break;
     }
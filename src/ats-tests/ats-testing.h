@@ -464,7 +464,8 @@ enum OperationType
   START_SEND,
   STOP_SEND,
   START_PREFERENCE,
-  STOP_PREFERENCE
+  STOP_PREFERENCE,
+  SET_LINK
 };
 
 struct Episode;
@@ -496,6 +497,11 @@ struct GNUNET_ATS_TEST_Operation
   enum OperationType type;
   enum GeneratorType gen_type;
   enum GNUNET_ATS_PreferenceKind pref_type;
+
+  /**
+   * Link characteristics to emulate for #SET_LINK
+   */
+  struct GNUNET_TRANSPORT_EmulationParameters link;
 };
 
 struct Episode
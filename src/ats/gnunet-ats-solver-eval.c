@@ -84,6 +84,138 @@ static int opt_disable_normalization;
 
 static int res;
 
+/**
+ * Replay of recorded ATS event traces
+ */
+
+/**
+ * Types of events in an ATS trace, see gnunet-service-ats_trace.h
+ */
+enum ReplayEventType
+{
+  REPLAY_ADD,
+  REPLAY_UPDATE,
+  REPLAY_DEL,
+  REPLAY_PREF,
+  REPLAY_REQUEST,
+  REPLAY_REQUEST_STOP
+};
+
+
+/**
+ * An event parsed from an ATS trace
+ */
+struct ReplayEvent
+{
+  enum ReplayEventType type;
+
+  /**
+   * Peer number from the trace
+   */
+  unsigned int peer;
+
+  /**
+   * Address (session) number from the trace
+   */
+  unsigned int aid;
+
+  /**
+   * Network of an added address
+   */
+  uint32_t network;
+
+  /**
+   * Properties of an added or updated address
+   */
+  struct GNUNET_ATS_Properties prop;
+
+  /**
+   * Preference kind of a preference change
+   */
+  enum GNUNET_ATS_PreferenceKind kind;
+
+  /**
+   * Preference change
+   */
+  double value;
+
+  /**
+   * Plugin of an added address
+   */
+  char plugin[32];
+};
+
+
+/**
+ * Statistics collected while replaying a trace against one solver
+ */
+struct ReplayStats
+{
+  /**
+   * Time the solver needed to process each event, in microseconds
+   */
+  uint64_t *latency;
+
+  /**
+   * Number of bandwidth assignments the solver handed out
+   */
+  unsigned long long bw_changes;
+
+  /**
+   * Number of times a peer was switched to a different address
+   */
+  unsigned long long switches;
+
+  /**
+   * Number of times a peer was disconnected by the solver
+   */
+  unsigned long long disconnects;
+};
+
+
+/**
+ * cmd option -r: trace to replay
+ */
+static char *opt_replay_file;
+
+/**
+ * Configuration to use for the solvers when replaying
+ */
+static const struct GNUNET_CONFIGURATION_Handle *replay_cfg;
+
+/**
+ * Events of the trace
+ */
+static struct ReplayEvent *replay_events;
+
+/**
+ * Number of events in #replay_events
+ */
+static unsigned int replay_events_count;
+
+/**
+ * Statistics for the replay currently running, NULL if not replaying
+ */
+static struct ReplayStats *replay_stats;
+
+/**
+ * Peers of the replay, mapped by peer identity
+ */
+static struct GNUNET_CONTAINER_MultiPeerMap *replay_peers;
+
+/**
+ * Smallest and largest value seen for each property during the
+ * replay, used to normalize the properties
+ */
+static uint64_t replay_prop_min[4];
+static uint64_t replay_prop_max[4];
+
+/**
+ * Sum of the absolute preferences of all peers for each kind
+ */
+static double replay_pref_sum[GNUNET_ATS_PreferenceCount];
+
+
 static void
 end_now ();
 
@@ -2955,6 +3087,30 @@ solver_bandwidth_changed_cb (void *cls, struct ATS_Address *address)
   struct TestPeer *p;
   static struct PreferenceGenerator *pg;
   uint32_t delta;
+
+  if (NULL != replay_stats)
+  {
+    replay_stats->bw_changes++;
+    p = GNUNET_CONTAINER_multipeermap_get (replay_peers, &address->peer);
+    if (NULL == p)
+      return;
+    if ( (0 == address->assigned_bw_out) && (0 == address->assigned_bw_in) )
+    {
+      if (p->active_address == address)
+      {
+        replay_stats->disconnects++;
+        p->active_address = NULL;
+      }
+      return;
+    }
+    if (p->active_address != address)
+    {
+      if (NULL != p->active_address)
+        replay_stats->switches++;
+      p->active_address = address;
+    }
+    return;
+  }
   if ( (0 == address->assigned_bw_out) && (0 == address->assigned_bw_in) )
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
@@ -3001,6 +3157,13 @@ const double *
 get_preferences_cb (void *cls, const struct GNUNET_PeerIdentity *id)
 {
   struct TestPeer *p;
+
+  if (NULL != replay_stats)
+  {
+    if (NULL == (p = GNUNET_CONTAINER_multipeermap_get (replay_peers, id)))
+      return NULL;
+    return p->pref_norm;
+  }
   if (GNUNET_YES == opt_disable_normalization)
   {
     if (NULL == (p = find_peer_by_pid (id)))
@@ -3013,27 +3176,50 @@ get_preferences_cb (void *cls, const struct GNUNET_PeerIdentity *id)
 }
 
 
-struct SolverHandle *
-GNUNET_ATS_solvers_solver_start (enum GNUNET_ATS_Solvers type)
+static unsigned int
+get_connectivity_cb (void *cls, const struct GNUNET_PeerIdentity *id)
 {
-  struct SolverHandle *sh;
-  char * solver_str;
+  struct TestPeer *p;
 
+  if (NULL != replay_stats)
+    p = GNUNET_CONTAINER_multipeermap_get (replay_peers, id);
+  else
+    p = find_peer_by_pid (id);
+  if (NULL == p)
+    return 0;
+  return p->is_requested;
+}
+
+
+static const char *
+solver_name (enum GNUNET_ATS_Solvers type)
+{
   switch (type) {
     case GNUNET_ATS_SOLVER_PROPORTIONAL:
-      solver_str = "proportional";
-      break;
+      return "proportional";
     case GNUNET_ATS_SOLVER_MLP:
-      solver_str = "mlp";
-      break;
+      return "mlp";
     case GNUNET_ATS_SOLVER_RIL:
-      solver_str = "ril";
-      break;
+      return "ril";
     default:
-      GNUNET_break (0);
       return NULL;
-      break;
   }
+}
+
+
+struct SolverHandle *
+GNUNET_ATS_solvers_solver_start (enum GNUNET_ATS_Solvers type)
+{
+  const struct GNUNET_CONFIGURATION_Handle *cfg;
+  struct SolverHandle *sh;
+  const char *solver_str;
+
+  if (NULL == (solver_str = solver_name (type)))
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  cfg = (NULL != e) ? e->cfg : replay_cfg;
 
   sh = GNUNET_new (struct SolverHandle);
   GNUNET_asprintf (&sh->plugin,
@@ -3042,11 +3228,12 @@ GNUNET_ATS_solvers_solver_start (enum GNUNET_ATS_Solvers type)
   sh->addresses = GNUNET_CONTAINER_multipeermap_create (128, GNUNET_NO);
 
   /* setup environment */
-  sh->env.cfg = e->cfg;
-  sh->env.stats = GNUNET_STATISTICS_create ("ats", e->cfg);
+  sh->env.cfg = cfg;
+  sh->env.stats = GNUNET_STATISTICS_create ("ats", cfg);
   sh->env.addresses = sh->addresses;
   sh->env.bandwidth_changed_cb = &solver_bandwidth_changed_cb;
   sh->env.get_preferences = &get_preferences_cb;
+  sh->env.get_connectivity = &get_connectivity_cb;
   sh->env.network_count = GNUNET_ATS_NetworkTypeCount;
   sh->env.info_cb = &solver_info_cb;
   sh->env.network_count = GNUNET_ATS_NetworkTypeCount;
@@ -3055,7 +3242,7 @@ GNUNET_ATS_solvers_solver_start (enum GNUNET_ATS_Solvers type)
   GAS_normalization_start ();
 
   /* load quotas */
-  if (GNUNET_ATS_NetworkTypeCount != GNUNET_ATS_solvers_load_quotas (e->cfg,
+  if (GNUNET_ATS_NetworkTypeCount != GNUNET_ATS_solvers_load_quotas (cfg,
       sh->env.out_quota, sh->env.in_quota, GNUNET_ATS_NetworkTypeCount))
   {
     GNUNET_break(0);
@@ -3079,6 +3266,482 @@ GNUNET_ATS_solvers_solver_start (enum GNUNET_ATS_Solvers type)
 }
 
 
+/**
+ * Parse a line of an ATS trace.
+ *
+ * @param line the line
+ * @param ev where to store the event
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on malformed lines
+ */
+static int
+replay_parse_line (const char *line,
+                   struct ReplayEvent *ev)
+{
+  unsigned long long t;
+  unsigned long long delay;
+  unsigned int kind;
+  unsigned int client;
+  char type[16];
+
+  memset (ev, 0, sizeof (struct ReplayEvent));
+  if (2 != sscanf (line, "%llu %15s", &t, type))
+    return GNUNET_SYSERR;
+  if (0 == strcmp (type, "add"))
+  {
+    ev->type = REPLAY_ADD;
+    if (9 != sscanf (line, "%llu %*s %u %u %31s %u %llu %u %u %u",
+                     &t, &ev->peer, &ev->aid, ev->plugin, &ev->network,
+                     &delay, &ev->prop.distance,
+                     &ev->prop.utilization_out, &ev->prop.utilization_in))
+      return GNUNET_SYSERR;
+    ev->prop.scope = ev->network;
+    ev->prop.delay.rel_value_us = delay;
+    return GNUNET_OK;
+  }
+  if (0 == strcmp (type, "update"))
+  {
+    ev->type = REPLAY_UPDATE;
+    if (7 != sscanf (line, "%llu %*s %u %u %llu %u %u %u",
+                     &t, &ev->peer, &ev->aid, &delay, &ev->prop.distance,
+                     &ev->prop.utilization_out, &ev->prop.utilization_in))
+      return GNUNET_SYSERR;
+    ev->prop.delay.rel_value_us = delay;
+    return GNUNET_OK;
+  }
+  if (0 == strcmp (type, "del"))
+  {
+    ev->type = REPLAY_DEL;
+    if (3 != sscanf (line, "%llu %*s %u %u", &t, &ev->peer, &ev->aid))
+      return GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  if (0 == strcmp (type, "pref"))
+  {
+    ev->type = REPLAY_PREF;
+    if (5 != sscanf (line, "%llu %*s %u %u %u %lf",
+                     &t, &ev->peer, &client, &kind, &ev->value))
+      return GNUNET_SYSERR;
+    if (kind >= GNUNET_ATS_PREFERENCE_END)
+      return GNUNET_SYSERR;
+    ev->kind = kind;
+    return GNUNET_OK;
+  }
+  if (0 == strcmp (type, "request"))
+  {
+    ev->type = REPLAY_REQUEST;
+    if (2 != sscanf (line, "%llu %*s %u", &t, &ev->peer))
+      return GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  if (0 == strcmp (type, "request-stop"))
+  {
+    ev->type = REPLAY_REQUEST_STOP;
+    if (2 != sscanf (line, "%llu %*s %u", &t, &ev->peer))
+      return GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Load an ATS trace into #replay_events.
+ *
+ * @param filename the trace
+ * @return #GNUNET_OK on success
+ */
+static int
+replay_load (const char *filename)
+{
+  FILE *f;
+  char line[256];
+  unsigned int size;
+  unsigned int lineno;
+
+  f = FOPEN (filename, "r");
+  if (NULL == f)
+  {
+    fprintf (stderr, "Failed to open trace `%s': %s\n",
+             filename, STRERROR (errno));
+    return GNUNET_SYSERR;
+  }
+  size = 0;
+  lineno = 0;
+  while (NULL != fgets (line, sizeof (line), f))
+  {
+    lineno++;
+    if (replay_events_count == size)
+      GNUNET_array_grow (replay_events, size, GNUNET_MAX (1024, 2 * size));
+    if (GNUNET_OK !=
+        replay_parse_line (line, &replay_events[replay_events_count]))
+    {
+      fprintf (stderr, "Ignoring malformed line %u in trace `%s'\n",
+               lineno, filename);
+      continue;
+    }
+    replay_events_count++;
+  }
+  fclose (f);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Get the replayed peer with the given trace number.
+ *
+ * @param id the number of the peer in the trace
+ * @param create #GNUNET_YES to create the peer if it does not exist
+ * @return the peer, NULL if not found
+ */
+static struct TestPeer *
+replay_get_peer (unsigned int id,
+                 int create)
+{
+  struct GNUNET_PeerIdentity pid;
+  struct TestPeer *p;
+  uint32_t nid;
+  int c;
+
+  memset (&pid, 0, sizeof (pid));
+  nid = htonl (id);
+  memcpy (&pid, &nid, sizeof (nid));
+  p = GNUNET_CONTAINER_multipeermap_get (replay_peers, &pid);
+  if ( (NULL != p) || (GNUNET_NO == create) )
+    return p;
+  p = GNUNET_new (struct TestPeer);
+  p->id = id;
+  p->peer_id = pid;
+  for (c = 0; c < GNUNET_ATS_PreferenceCount; c++)
+  {
+    p->pref_abs[c] = DEFAULT_ABS_PREFERENCE;
+    p->pref_norm[c] = DEFAULT_REL_PREFERENCE;
+  }
+  GNUNET_CONTAINER_DLL_insert (peer_head, peer_tail, p);
+  GNUNET_CONTAINER_multipeermap_put (replay_peers, &p->peer_id, p,
+      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+  return p;
+}
+
+
+/**
+ * Normalize a property to [1.0...2.0] using the range seen so far
+ * in the replay.
+ *
+ * @param i index of the property
+ * @param value the value
+ * @return normalized value
+ */
+static double
+replay_normalize (unsigned int i,
+                  uint64_t value)
+{
+  if (value < replay_prop_min[i])
+    replay_prop_min[i] = value;
+  if (value > replay_prop_max[i])
+    replay_prop_max[i] = value;
+  if (replay_prop_max[i] == replay_prop_min[i])
+    return DEFAULT_REL_QUALITY;
+  return DEFAULT_REL_QUALITY + (double) (value - replay_prop_min[i]) /
+      (replay_prop_max[i] - replay_prop_min[i]);
+}
+
+
+/**
+ * Set the properties of a replayed address and normalize them.
+ *
+ * @param aa the address
+ * @param prop the new properties
+ */
+static void
+replay_set_properties (struct ATS_Address *aa,
+                       const struct GNUNET_ATS_Properties *prop)
+{
+  enum GNUNET_ATS_Network_Type scope;
+
+  scope = aa->properties.scope;
+  aa->properties = *prop;
+  aa->properties.scope = scope;
+  aa->norm_delay.avg = prop->delay.rel_value_us;
+  aa->norm_delay.norm = replay_normalize (0, aa->norm_delay.avg);
+  aa->norm_distance.avg = prop->distance;
+  aa->norm_distance.norm = replay_normalize (1, aa->norm_distance.avg);
+  aa->norm_utilization_out.avg = prop->utilization_out;
+  aa->norm_utilization_out.norm = replay_normalize (2, aa->norm_utilization_out.avg);
+  aa->norm_utilization_in.avg = prop->utilization_in;
+  aa->norm_utilization_in.norm = replay_normalize (3, aa->norm_utilization_in.avg);
+}
+
+
+/**
+ * Pass a single event to the solver.
+ *
+ * @param ev the event
+ * @return #GNUNET_YES if the event was passed to the solver,
+ *         #GNUNET_NO if it does not apply (unknown peer or address)
+ */
+static int
+replay_event (const struct ReplayEvent *ev)
+{
+  struct TestPeer *p;
+  struct TestAddress *a;
+  char addr[16];
+
+  p = replay_get_peer (ev->peer, (REPLAY_ADD == ev->type) ? GNUNET_YES : GNUNET_NO);
+  if (NULL == p)
+    return GNUNET_NO;
+  switch (ev->type)
+  {
+  case REPLAY_ADD:
+    if (NULL != find_address_by_id (p, ev->aid))
+      return GNUNET_NO;
+    a = GNUNET_new (struct TestAddress);
+    a->aid = ev->aid;
+    a->network = ev->network;
+    GNUNET_snprintf (addr, sizeof (addr), "%u", ev->aid);
+    a->ats_addr = GNUNET_malloc (sizeof (struct ATS_Address) +
+                                 strlen (addr) + 1 + strlen (ev->plugin) + 1);
+    a->ats_addr->peer = p->peer_id;
+    a->ats_addr->addr_len = strlen (addr) + 1;
+    a->ats_addr->addr = &a->ats_addr[1];
+    a->ats_addr->plugin = (char *) &a->ats_addr[1] + a->ats_addr->addr_len;
+    memcpy (&a->ats_addr[1], addr, a->ats_addr->addr_len);
+    strcpy (a->ats_addr->plugin, ev->plugin);
+    a->ats_addr->session_id = ev->aid;
+    a->ats_addr->properties.scope = ev->network;
+    replay_set_properties (a->ats_addr, &ev->prop);
+    GNUNET_CONTAINER_DLL_insert_tail (p->addr_head, p->addr_tail, a);
+    GNUNET_CONTAINER_multipeermap_put (sh->addresses, &p->peer_id, a->ats_addr,
+        GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+    sh->sf->s_add (sh->sf->cls, a->ats_addr, ev->network);
+    return GNUNET_YES;
+  case REPLAY_UPDATE:
+    if (NULL == (a = find_address_by_id (p, ev->aid)))
+      return GNUNET_NO;
+    replay_set_properties (a->ats_addr, &ev->prop);
+    sh->sf->s_address_update_property (sh->sf->cls, a->ats_addr);
+    return GNUNET_YES;
+  case REPLAY_DEL:
+    if (NULL == (a = find_address_by_id (p, ev->aid)))
+      return GNUNET_NO;
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multipeermap_remove (sh->addresses,
+                                                         &p->peer_id,
+                                                         a->ats_addr));
+    sh->sf->s_del (sh->sf->cls, a->ats_addr);
+    if (p->active_address == a->ats_addr)
+      p->active_address = NULL;
+    GNUNET_CONTAINER_DLL_remove (p->addr_head, p->addr_tail, a);
+    GNUNET_free (a->ats_addr);
+    GNUNET_free (a);
+    return GNUNET_YES;
+  case REPLAY_PREF:
+    p->pref_abs[ev->kind] += ev->value;
+    replay_pref_sum[ev->kind] += ev->value;
+    if (replay_pref_sum[ev->kind] > 0.0)
+      p->pref_norm[ev->kind] = DEFAULT_REL_PREFERENCE +
+          p->pref_abs[ev->kind] / replay_pref_sum[ev->kind];
+    sh->sf->s_pref (sh->sf->cls, &p->peer_id, ev->kind,
+                    p->pref_norm[ev->kind]);
+    return GNUNET_YES;
+  case REPLAY_REQUEST:
+    p->is_requested++;
+    sh->sf->s_get (sh->sf->cls, &p->peer_id);
+    return GNUNET_YES;
+  case REPLAY_REQUEST_STOP:
+    if (0 == p->is_requested)
+      return GNUNET_NO;
+    p->is_requested--;
+    sh->sf->s_get_stop (sh->sf->cls, &p->peer_id);
+    return GNUNET_YES;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Get the CPU time used by this process so far.
+ *
+ * @return CPU time (user and system) in microseconds
+ */
+static uint64_t
+replay_cpu_time ()
+{
+#if HAVE_GETRUSAGE
+  struct rusage ru;
+
+  if (0 == getrusage (RUSAGE_SELF, &ru))
+    return ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec
+      + ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+#endif
+  return 0;
+}
+
+
+/**
+ * Compare two latencies for qsort().
+ */
+static int
+replay_cmp_latency (const void *a,
+                    const void *b)
+{
+  const uint64_t *la = a;
+  const uint64_t *lb = b;
+
+  if (*la < *lb)
+    return -1;
+  if (*la > *lb)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Remove all peers and addresses of a replay.
+ */
+static void
+replay_cleanup ()
+{
+  struct TestPeer *p;
+  struct TestAddress *a;
+
+  while (NULL != (p = peer_head))
+  {
+    while (NULL != (a = p->addr_head))
+    {
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multipeermap_remove (sh->addresses,
+                                                           &p->peer_id,
+                                                           a->ats_addr));
+      sh->sf->s_del (sh->sf->cls, a->ats_addr);
+      GNUNET_CONTAINER_DLL_remove (p->addr_head, p->addr_tail, a);
+      GNUNET_free (a->ats_addr);
+      GNUNET_free (a);
+    }
+    GNUNET_CONTAINER_multipeermap_remove (replay_peers, &p->peer_id, p);
+    GNUNET_CONTAINER_DLL_remove (peer_head, peer_tail, p);
+    GNUNET_free (p);
+  }
+}
+
+
+/**
+ * Replay the loaded trace against a solver and print the results.
+ *
+ * @param type the solver to use
+ * @return #GNUNET_OK on success
+ */
+static int
+replay_run (enum GNUNET_ATS_Solvers type)
+{
+  struct ReplayStats stats;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Absolute t;
+  struct GNUNET_TIME_Relative total;
+  uint64_t cpu;
+  unsigned int count;
+  unsigned int i;
+  int c;
+
+  sh = GNUNET_ATS_solvers_solver_start (type);
+  if (NULL == sh)
+    return GNUNET_SYSERR;
+  memset (&stats, 0, sizeof (stats));
+  stats.latency = GNUNET_malloc_large (replay_events_count * sizeof (uint64_t) + 1);
+  GNUNET_assert (NULL != stats.latency);
+  for (c = 0; c < 4; c++)
+  {
+    replay_prop_min[c] = UINT64_MAX;
+    replay_prop_max[c] = 0;
+  }
+  for (c = 0; c < GNUNET_ATS_PreferenceCount; c++)
+    replay_pref_sum[c] = DEFAULT_ABS_PREFERENCE;
+  replay_peers = GNUNET_CONTAINER_multipeermap_create (1024, GNUNET_NO);
+  replay_stats = &stats;
+
+  count = 0;
+  cpu = replay_cpu_time ();
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < replay_events_count; i++)
+  {
+    t = GNUNET_TIME_absolute_get ();
+    if (GNUNET_YES == replay_event (&replay_events[i]))
+      stats.latency[count++] = GNUNET_TIME_absolute_get_duration (t).rel_value_us;
+  }
+  total = GNUNET_TIME_absolute_get_duration (start);
+  cpu = replay_cpu_time () - cpu;
+
+  qsort (stats.latency, count, sizeof (uint64_t), &replay_cmp_latency);
+  fprintf (stdout,
+           "%s: %u events in %s, CPU %llu ms\n",
+           sh->plugin,
+           count,
+           GNUNET_STRINGS_relative_time_to_string (total, GNUNET_YES),
+           (unsigned long long) (cpu / 1000));
+  if (count > 0)
+    fprintf (stdout,
+             "%s: latency us p50 %llu p90 %llu p99 %llu max %llu\n",
+             sh->plugin,
+             (unsigned long long) stats.latency[count / 2],
+             (unsigned long long) stats.latency[(count * 9) / 10],
+             (unsigned long long) stats.latency[(count * 99) / 100],
+             (unsigned long long) stats.latency[count - 1]);
+  fprintf (stdout,
+           "%s: churn %llu bandwidth changes, %llu address switches, %llu disconnects\n",
+           sh->plugin,
+           stats.bw_changes,
+           stats.switches,
+           stats.disconnects);
+
+  replay_cleanup ();
+  replay_stats = NULL;
+  GNUNET_CONTAINER_multipeermap_destroy (replay_peers);
+  replay_peers = NULL;
+  GNUNET_free (stats.latency);
+  GNUNET_ATS_solvers_solver_stop (sh);
+  sh = NULL;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Replay the trace given with -r against the solver(s) given with -s.
+ *
+ * @param cfg configuration to use for the solvers
+ */
+static void
+replay (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  static const enum GNUNET_ATS_Solvers all[] = {
+    GNUNET_ATS_SOLVER_PROPORTIONAL,
+    GNUNET_ATS_SOLVER_MLP,
+    GNUNET_ATS_SOLVER_RIL
+  };
+  unsigned int i;
+
+  replay_cfg = cfg;
+  if (GNUNET_OK != replay_load (opt_replay_file))
+  {
+    res = 1;
+    return;
+  }
+  fprintf (stdout, "Replaying %u events from `%s'\n",
+           replay_events_count, opt_replay_file);
+  for (i = 0; i < sizeof (all) / sizeof (all[0]); i++)
+  {
+    if ( (0 != strcmp (opt_solver, "all")) &&
+         (0 != strcmp (opt_solver, solver_name (all[i]))) )
+      continue;
+    if (GNUNET_OK != replay_run (all[i]))
+    {
+      fprintf (stderr, "Failed to start solver `%s'\n",
+               solver_name (all[i]));
+      res = 1;
+    }
+  }
+  GNUNET_array_grow (replay_events, replay_events_count, 0);
+}
+
+
 static void
 done ()
 {
@@ -3191,6 +3854,18 @@ run (void *cls, char * const *args, const char *cfgfile,
   enum GNUNET_ATS_Solvers solver;
   int c;
 
+  if (NULL != opt_replay_file)
+  {
+    if (NULL == opt_solver)
+    {
+      fprintf (stderr, "No solver given ...\n");
+      res = 1;
+      return;
+    }
+    replay (cfg);
+    return;
+  }
+
   if (NULL == opt_exp_file)
   {
     fprintf (stderr, "No experiment given ...\n");
@@ -3304,6 +3979,9 @@ main (int argc, char *argv[])
     {  'd', "dn", NULL,
         gettext_noop ("disable normalization"),
         0, &GNUNET_GETOPT_set_one, &opt_disable_normalization},
+    {  'r', "replay", "FILE",
+        gettext_noop ("replay an ATS trace against the solver (or `all' solvers)"),
+        1, &GNUNET_GETOPT_set_string, &opt_replay_file},
     GNUNET_GETOPT_OPTION_END
   };
 
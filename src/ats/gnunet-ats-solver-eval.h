@@ -160,6 +160,11 @@ struct TestPeer
   uint32_t assigned_bw_in;
   uint32_t assigned_bw_out;
 
+  /**
+   * Address the solver last assigned bandwidth to (replay only)
+   */
+  struct ATS_Address *active_address;
+
   struct TestAddress *addr_head;
   struct TestAddress *addr_tail;
 };
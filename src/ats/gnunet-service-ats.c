@@ -35,6 +35,7 @@
 #include "gnunet-service-ats_scheduling.h"
 #include "gnunet-service-ats_reservations.h"
 #include "gnunet-service-ats_plugins.h"
+#include "gnunet-service-ats_trace.h"
 #include "ats.h"
 
 /**
@@ -138,6 +139,7 @@ cleanup_task (void *cls,
   GAS_performance_done ();
   GAS_preference_done ();
   GAS_reservations_done ();
+  GAS_trace_done ();
   GNUNET_SERVER_disconnect_notify_cancel (GSA_server,
                                           &client_disconnect_handler,
                                           NULL);
@@ -193,6 +195,7 @@ run (void *cls,
   };
   GSA_server = server;
   GSA_stats = GNUNET_STATISTICS_create ("ats", cfg);
+  GAS_trace_init (cfg);
   GAS_reservations_init (server);
   GAS_connectivity_init ();
   GAS_preference_init ();
@@ -207,6 +210,7 @@ run (void *cls,
     GAS_reservations_done ();
     GAS_connectivity_done ();
     GAS_preference_done ();
+    GAS_trace_done ();
     if (NULL != GSA_stats)
     {
       GNUNET_STATISTICS_destroy (GSA_stats, GNUNET_NO);
@@ -29,6 +29,7 @@
 #include "gnunet-service-ats_performance.h"
 #include "gnunet-service-ats_normalization.h"
 #include "gnunet-service-ats_plugins.h"
+#include "gnunet-service-ats_trace.h"
 
 
 /**
@@ -63,6 +64,8 @@ free_address (struct ATS_Address *addr)
                                                        &addr->peer,
                                                        addr));
   update_addresses_stat ();
+  GAS_trace_address_delete (addr);
+  GAS_normalization_delete_address (addr);
   GAS_plugin_delete_address (addr);
   GAS_performance_notify_all_clients (&addr->peer,
                                       addr->plugin,
@@ -246,10 +249,10 @@ GAS_addresses_add (const struct GNUNET_PeerIdentity *peer,
 	      GNUNET_i2s (peer),
 	      session_id);
   /* Tell solver about new address */
-  GAS_plugin_solver_lock ();
+  GAS_trace_address_add (new_address);
   GAS_plugin_new_address (new_address);
-  GAS_normalization_update_property (new_address); // FIXME: needed?
-  GAS_plugin_solver_unlock ();
+  GAS_normalization_update_property (new_address,
+                                     NULL);
   /* Notify performance clients about new address */
   GAS_performance_notify_all_clients (&new_address->peer,
 				      new_address->plugin,
@@ -276,6 +279,7 @@ GAS_addresses_update (const struct GNUNET_PeerIdentity *peer,
                       const struct GNUNET_ATS_Properties *prop)
 {
   struct ATS_Address *aa;
+  struct GNUNET_ATS_Properties prev;
 
   /* Get existing address */
   aa = find_exact_address (peer,
@@ -297,7 +301,9 @@ GAS_addresses_update (const struct GNUNET_PeerIdentity *peer,
 
   /* Update address */
   aa->t_last_activity = GNUNET_TIME_absolute_get();
+  prev = aa->properties;
   aa->properties = *prop;
+  GAS_trace_address_update (aa);
   /* Notify performance clients about updated address */
   GAS_performance_notify_all_clients (&aa->peer,
                                       aa->plugin,
@@ -309,7 +315,8 @@ GAS_addresses_update (const struct GNUNET_PeerIdentity *peer,
                                       GNUNET_BANDWIDTH_value_init (aa->assigned_bw_out),
                                       GNUNET_BANDWIDTH_value_init (aa->assigned_bw_in));
 
-  GAS_normalization_update_property (aa);
+  GAS_normalization_update_property (aa,
+                                     &prev);
 }
 
 
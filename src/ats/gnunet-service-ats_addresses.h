@@ -254,6 +254,16 @@ struct GAS_NormalizationInfo
  */
 struct ATS_Address
 {
+  /**
+   * Next in DLL of addresses waiting for normalization.
+   */
+  struct ATS_Address *next;
+
+  /**
+   * Previous in DLL of addresses waiting for normalization.
+   */
+  struct ATS_Address *prev;
+
   /**
    * Peer ID this address is for.
    */
@@ -334,6 +344,11 @@ struct ATS_Address
    */
   int active;
 
+  /**
+   * #GNUNET_YES if this address is waiting for normalization.
+   */
+  int norm_pending;
+
   /**
    * Normalized delay information for this address.
    */
@@ -33,6 +33,12 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "ats-normalization",__VA_ARGS__)
 
+/**
+ * For how long do we collect property updates before normalizing
+ * them and telling the solver?
+ */
+#define NORMALIZATION_BATCH_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
 
 /**
  * Range information for normalization of quality properties.
@@ -56,6 +62,34 @@ struct PropertyRange
  */
 static struct PropertyRange property_range;
 
+/**
+ * Addresses with property updates waiting for #normalize_pending(): head
+ */
+static struct ATS_Address *pending_head;
+
+/**
+ * Addresses with property updates waiting for #normalize_pending(): tail
+ */
+static struct ATS_Address *pending_tail;
+
+/**
+ * Task normalizing the pending addresses.
+ */
+static struct GNUNET_SCHEDULER_Task *normalize_task;
+
+/**
+ * #GNUNET_YES if @e property_range was widened since the last
+ * normalization, so all addresses must be renormalized.
+ */
+static int range_changed;
+
+/**
+ * #GNUNET_YES if a value defining a limit of @e property_range
+ * changed or went away, so the range may have to shrink and must
+ * be recomputed from all addresses.
+ */
+static int range_dirty;
+
 
 /**
  * Add the value from @a atsi to the running average of the
@@ -92,6 +126,35 @@ update_avg (uint64_t current_val,
 }
 
 
+/**
+ * Widen the range @a pr to include the values of @a prop.
+ *
+ * @param pr range to update
+ * @param prop properties of an address
+ */
+static void
+add_to_range (struct PropertyRange *pr,
+              const struct GNUNET_ATS_Properties *prop)
+{
+  pr->max.utilization_out = GNUNET_MAX (pr->max.utilization_out,
+                                        prop->utilization_out);
+  pr->max.utilization_in = GNUNET_MAX (pr->max.utilization_in,
+                                       prop->utilization_in);
+  pr->max.distance = GNUNET_MAX (pr->max.distance,
+                                 prop->distance);
+  pr->max.delay = GNUNET_TIME_relative_max (pr->max.delay,
+                                            prop->delay);
+  pr->min.utilization_out = GNUNET_MIN (pr->min.utilization_out,
+                                        prop->utilization_out);
+  pr->min.utilization_in = GNUNET_MIN (pr->min.utilization_in,
+                                       prop->utilization_in);
+  pr->min.distance = GNUNET_MIN (pr->min.distance,
+                                 prop->distance);
+  pr->min.delay = GNUNET_TIME_relative_min (pr->min.delay,
+                                            prop->delay);
+}
+
+
 /**
  * Function called for all addresses and peers to find the minimum and
  * maximum (averaged) values for a given quality property.  Given
@@ -110,22 +173,8 @@ find_min_max_it (void *cls,
   struct PropertyRange *pr = cls;
   const struct ATS_Address *a = k;
 
-  pr->max.utilization_out = GNUNET_MAX (pr->max.utilization_out,
-                                        a->properties.utilization_out);
-  pr->max.utilization_in = GNUNET_MAX (pr->max.utilization_in,
-                                       a->properties.utilization_in);
-  pr->max.distance = GNUNET_MAX (pr->max.distance,
-                                 a->properties.distance);
-  pr->max.delay = GNUNET_TIME_relative_max (pr->max.delay,
-                                            a->properties.delay);
-  pr->min.utilization_out = GNUNET_MIN (pr->min.utilization_out,
-                                        a->properties.utilization_out);
-  pr->min.utilization_in = GNUNET_MIN (pr->min.utilization_in,
-                                       a->properties.utilization_in);
-  pr->min.distance = GNUNET_MIN (pr->min.distance,
-                                 a->properties.distance);
-  pr->min.delay = GNUNET_TIME_relative_min (pr->min.delay,
-                                            a->properties.delay);
+  add_to_range (pr,
+                &a->properties);
   return GNUNET_OK;
 }
 
@@ -151,6 +200,51 @@ update_norm (uint64_t min,
 }
 
 
+/**
+ * Widen #property_range to include the values of @a prop.
+ *
+ * @param prop properties of an address
+ */
+static void
+extend_range (const struct GNUNET_ATS_Properties *prop)
+{
+  struct PropertyRange old;
+
+  old = property_range;
+  add_to_range (&property_range,
+                prop);
+  if (0 != memcmp (&old,
+                   &property_range,
+                   sizeof (struct PropertyRange)))
+    range_changed = GNUNET_YES;
+}
+
+
+/**
+ * Check if any of the values in @a prop defines a limit of
+ * #property_range.
+ *
+ * @param prop properties of an address
+ * @return #GNUNET_YES if @a prop is on the border of the range
+ */
+static int
+is_range_limit (const struct GNUNET_ATS_Properties *prop)
+{
+  const struct PropertyRange *pr = &property_range;
+
+  if ( (prop->utilization_out == pr->min.utilization_out) ||
+       (prop->utilization_out == pr->max.utilization_out) ||
+       (prop->utilization_in == pr->min.utilization_in) ||
+       (prop->utilization_in == pr->max.utilization_in) ||
+       (prop->distance == pr->min.distance) ||
+       (prop->distance == pr->max.distance) ||
+       (prop->delay.rel_value_us == pr->min.delay.rel_value_us) ||
+       (prop->delay.rel_value_us == pr->max.delay.rel_value_us) )
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
 /**
  * Normalize the property value for a given address based
  * on the range we know that property values have globally.
@@ -223,57 +317,142 @@ init_range (struct PropertyRange *pr)
 
 
 /**
- * Update and normalize atsi performance information
+ * Normalize the addresses whose properties changed since the last
+ * run, as one bulk operation of the solver.  The range is only
+ * recomputed from all addresses if one of its limits may have
+ * shrunk; all addresses are only renormalized if the range changed.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+normalize_pending (void *cls,
+                   const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct PropertyRange range;
+  struct ATS_Address *address;
+
+  normalize_task = NULL;
+  if (GNUNET_YES == range_dirty)
+  {
+    init_range (&range);
+    GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
+                                           &find_min_max_it,
+                                           &range);
+    if (0 != memcmp (&range,
+                     &property_range,
+                     sizeof (struct PropertyRange)))
+    {
+      property_range = range;
+      range_changed = GNUNET_YES;
+    }
+    range_dirty = GNUNET_NO;
+  }
+  GAS_plugin_solver_lock ();
+  if (GNUNET_YES == range_changed)
+  {
+    /* limits changed, (re)normalize all addresses */
+    range_changed = GNUNET_NO;
+    while (NULL != (address = pending_head))
+    {
+      GNUNET_CONTAINER_DLL_remove (pending_head,
+                                   pending_tail,
+                                   address);
+      address->norm_pending = GNUNET_NO;
+    }
+    GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
+                                           &normalize_address,
+                                           NULL);
+    GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
+                                           &notify_change,
+                                           NULL);
+  }
+  else
+  {
+    /* renormalize just the updated addresses */
+    while (NULL != (address = pending_head))
+    {
+      GNUNET_CONTAINER_DLL_remove (pending_head,
+                                   pending_tail,
+                                   address);
+      address->norm_pending = GNUNET_NO;
+      normalize_address (NULL,
+                         &address->peer,
+                         address);
+      notify_change (NULL,
+                     &address->peer,
+                     address);
+    }
+  }
+  GAS_plugin_solver_unlock ();
+}
+
+
+/**
+ * Update and normalize atsi performance information.  The averages
+ * are updated immediately; normalization and the notification of the
+ * solver are batched for #NORMALIZATION_BATCH_DELAY.
  *
  * @param address the address to update
+ * @param prev properties of @a address before the update,
+ *        NULL for a new address
  */
 void
-GAS_normalization_update_property (struct ATS_Address *address)
+GAS_normalization_update_property (struct ATS_Address *address,
+                                   const struct GNUNET_ATS_Properties *prev)
 {
   const struct GNUNET_ATS_Properties *prop = &address->properties;
-  struct PropertyRange range;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Updating properties for peer `%s'\n",
        GNUNET_i2s (&address->peer));
-  GAS_plugin_solver_lock ();
   update_avg (prop->delay.rel_value_us,
               &address->norm_delay);
   update_avg (prop->distance,
               &address->norm_distance);
   update_avg (prop->utilization_in,
               &address->norm_utilization_in);
-  update_avg (prop->utilization_in,
+  update_avg (prop->utilization_out,
               &address->norm_utilization_out);
 
-  init_range (&range);
-  GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
-                                         &find_min_max_it,
-                                         &range);
-  if (0 != memcmp (&range,
-                   &property_range,
-                   sizeof (struct PropertyRange)))
+  if ( (NULL != prev) &&
+       (0 != memcmp (prev,
+                     prop,
+                     sizeof (struct GNUNET_ATS_Properties))) &&
+       (GNUNET_YES == is_range_limit (prev)) )
+    range_dirty = GNUNET_YES;
+  extend_range (prop);
+  if (GNUNET_NO == address->norm_pending)
   {
-    /* limits changed, (re)normalize all addresses */
-    property_range = range;
-    GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
-                                           &normalize_address,
-                                           NULL);
-    GNUNET_CONTAINER_multipeermap_iterate (GSA_addresses,
-                                           &notify_change,
-                                           NULL);
+    address->norm_pending = GNUNET_YES;
+    GNUNET_CONTAINER_DLL_insert_tail (pending_head,
+                                      pending_tail,
+                                      address);
   }
-  else
+  if (NULL == normalize_task)
+    normalize_task = GNUNET_SCHEDULER_add_delayed (NORMALIZATION_BATCH_DELAY,
+                                                   &normalize_pending,
+                                                   NULL);
+}
+
+
+/**
+ * An address is about to be freed, forget about it.
+ *
+ * @param address the address that is going away
+ */
+void
+GAS_normalization_delete_address (struct ATS_Address *address)
+{
+  if (GNUNET_YES == address->norm_pending)
   {
-    /* renormalize just this one address */
-    normalize_address (NULL,
-                       &address->peer,
-                       address);
-    notify_change (NULL,
-                   &address->peer,
-                   address);
+    GNUNET_CONTAINER_DLL_remove (pending_head,
+                                 pending_tail,
+                                 address);
+    address->norm_pending = GNUNET_NO;
   }
-  GAS_plugin_solver_unlock ();
+  if (GNUNET_YES == is_range_limit (&address->properties))
+    range_dirty = GNUNET_YES;
 }
 
 
@@ -284,6 +463,8 @@ void
 GAS_normalization_start ()
 {
   init_range (&property_range);
+  range_changed = GNUNET_NO;
+  range_dirty = GNUNET_NO;
 }
 
 
@@ -293,7 +474,20 @@ GAS_normalization_start ()
 void
 GAS_normalization_stop ()
 {
-  /* nothing to do */
+  struct ATS_Address *address;
+
+  if (NULL != normalize_task)
+  {
+    GNUNET_SCHEDULER_cancel (normalize_task);
+    normalize_task = NULL;
+  }
+  while (NULL != (address = pending_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pending_head,
+                                 pending_tail,
+                                 address);
+    address->norm_pending = GNUNET_NO;
+  }
 }
 
 
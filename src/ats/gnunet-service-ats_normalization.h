@@ -35,12 +35,26 @@
 
 
 /**
- * Update and normalize a @a prop performance information
+ * Update and normalize a @a prop performance information.
+ * Normalization and the notification of the solver happen
+ * in batches shortly after.
  *
  * @param address the address to update
+ * @param prev properties of @a address before the update,
+ *        NULL for a new address
  */
 void
-GAS_normalization_update_property (struct ATS_Address *address);
+GAS_normalization_update_property (struct ATS_Address *address,
+                                   const struct GNUNET_ATS_Properties *prev);
+
+
+/**
+ * An address is about to be freed, forget about it.
+ *
+ * @param address the address that is going away
+ */
+void
+GAS_normalization_delete_address (struct ATS_Address *address);
 
 
 /**
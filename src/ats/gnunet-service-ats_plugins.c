@@ -33,6 +33,7 @@
 #include "gnunet-service-ats_reservations.h"
 #include "gnunet-service-ats_scheduling.h"
 #include "gnunet-service-ats_normalization.h"
+#include "gnunet-service-ats_trace.h"
 
 
 /**
@@ -556,6 +557,7 @@ GAS_plugin_solver_unlock ()
 void
 GAS_plugin_request_connect_start (const struct GNUNET_PeerIdentity *pid)
 {
+  GAS_trace_request_start (pid);
   sf->s_get (sf->cls,
              pid);
 }
@@ -570,6 +572,7 @@ GAS_plugin_request_connect_start (const struct GNUNET_PeerIdentity *pid)
 void
 GAS_plugin_request_connect_stop (const struct GNUNET_PeerIdentity *pid)
 {
+  GAS_trace_request_stop (pid);
   sf->s_get_stop (sf->cls,
                   pid);
 }
@@ -30,6 +30,7 @@
 #include "gnunet-service-ats_plugins.h"
 #include "gnunet-service-ats_preferences.h"
 #include "gnunet-service-ats_reservations.h"
+#include "gnunet-service-ats_trace.h"
 #include "ats.h"
 
 #define LOG(kind,...) GNUNET_log_from (kind, "ats-preferences",__VA_ARGS__)
@@ -52,6 +53,12 @@
  */
 #define PREF_EPSILON 0.01
 
+/**
+ * For how long do we collect preference changes before recalculating
+ * the relative preferences and telling the solver?
+ */
+#define PREF_BATCH_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
 
 /**
  * Relative preferences for a peer.
@@ -146,6 +153,12 @@ struct PreferenceClient
    */
   double f_abs_sum[GNUNET_ATS_PREFERENCE_END];
 
+  /**
+   * #GNUNET_YES for each preference kind for which this client
+   * changed absolute preferences since the last recalculation.
+   */
+  int dirty[GNUNET_ATS_PREFERENCE_END];
+
 };
 
 
@@ -171,6 +184,11 @@ static struct PreferenceClient *pc_tail;
  */
 static struct GNUNET_SCHEDULER_Task *aging_task;
 
+/**
+ * Handle for task recalculating relative preferences after changes.
+ */
+static struct GNUNET_SCHEDULER_Task *recalc_task;
+
 
 /**
  * Closure for #sum_relative_preferences().
@@ -531,7 +549,7 @@ recalculate_relative_preferences (struct PreferenceClient *c,
  * @param value the kind of preference to calculate the
  *        new global relative preference values for
  * @param key the peer to update relative preference values for
- * @param value a `struct PeerRelative`, unused
+ * @param value a `struct PreferencePeer` of the client, unused
  */
 static int
 update_iterator (void *cls,
@@ -547,8 +565,45 @@ update_iterator (void *cls,
 
 
 /**
- * Update the absolute preference and calculate the
- * new relative preference value.
+ * Recalculate the relative preferences of all clients that changed
+ * their absolute preferences since the last run and notify the
+ * solver, as one bulk operation.  Only the peers of a changed
+ * client can have new relative preferences, so only those are
+ * updated.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+recalculate_pending (void *cls,
+                     const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct PreferenceClient *c_cur;
+  enum GNUNET_ATS_PreferenceKind kind;
+
+  recalc_task = NULL;
+  GAS_plugin_solver_lock ();
+  for (c_cur = pc_head; NULL != c_cur; c_cur = c_cur->next)
+  {
+    for (kind = 0; kind < GNUNET_ATS_PREFERENCE_END; kind++)
+    {
+      if (GNUNET_YES != c_cur->dirty[kind])
+        continue;
+      c_cur->dirty[kind] = GNUNET_NO;
+      recalculate_relative_preferences (c_cur,
+                                        kind);
+      GNUNET_CONTAINER_multipeermap_iterate (c_cur->peer2pref,
+                                             &update_iterator,
+                                             &kind);
+    }
+  }
+  GAS_plugin_solver_unlock ();
+}
+
+
+/**
+ * Update the absolute preference; the new relative preference
+ * values are calculated in a batch by #recalculate_pending().
  *
  * @param client the client with this preference
  * @param peer the peer to change the preference for
@@ -576,6 +631,10 @@ update_preference (struct GNUNET_SERVER_Client *client,
        GNUNET_i2s (peer),
        GNUNET_ATS_print_preference_type (kind),
        score_abs);
+  GAS_trace_preference (client,
+                        peer,
+                        kind,
+                        score_abs);
 
   /* Find preference client */
   for (c_cur = pc_head; NULL != c_cur; c_cur = c_cur->next)
@@ -634,10 +693,11 @@ update_preference (struct GNUNET_SERVER_Client *client,
   }
 
   p_cur->f_abs[kind] += score_abs;
-  recalculate_relative_preferences (c_cur, kind);
-  GNUNET_CONTAINER_multipeermap_iterate (preference_peers,
-					 &update_iterator,
-					 &kind);
+  c_cur->dirty[kind] = GNUNET_YES;
+  if (NULL == recalc_task)
+    recalc_task = GNUNET_SCHEDULER_add_delayed (PREF_BATCH_DELAY,
+                                                &recalculate_pending,
+                                                NULL);
 
   if (NULL == aging_task)
     aging_task = GNUNET_SCHEDULER_add_delayed (PREF_AGING_INTERVAL,
@@ -692,13 +752,11 @@ GAS_handle_preference_change (void *cls,
                             1,
                             GNUNET_NO);
   pi = (const struct PreferenceInformation *) &msg[1];
-  GAS_plugin_solver_lock ();
   for (i = 0; i < nump; i++)
     update_preference (client,
                        &msg->peer,
                        (enum GNUNET_ATS_PreferenceKind) ntohl (pi[i].preference_kind),
                        pi[i].preference_value);
-  GAS_plugin_solver_unlock ();
   GNUNET_SERVER_receive_done (client,
                               GNUNET_OK);
 }
@@ -733,6 +791,11 @@ GAS_preference_done ()
     GNUNET_SCHEDULER_cancel (aging_task);
     aging_task = NULL;
   }
+  if (NULL != recalc_task)
+  {
+    GNUNET_SCHEDULER_cancel (recalc_task);
+    recalc_task = NULL;
+  }
   next_pc = pc_head;
   while (NULL != (pc = next_pc))
   {
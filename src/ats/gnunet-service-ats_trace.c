@@ -0,0 +1,335 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file ats/gnunet-service-ats_trace.c
+ * @brief ats service, recording of the events driving the solver
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "gnunet-service-ats_trace.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "ats-trace",__VA_ARGS__)
+
+
+/**
+ * Handle of the trace file, NULL if we are not tracing.
+ */
+static struct GNUNET_BIO_WriteHandle *trace;
+
+/**
+ * Name of the trace file.
+ */
+static char *trace_fn;
+
+/**
+ * When did we start tracing?
+ */
+static struct GNUNET_TIME_Absolute trace_start;
+
+/**
+ * Map from peer identities to the numbers we use for them in the
+ * trace, stored as `uintptr_t` values.
+ */
+static struct GNUNET_CONTAINER_MultiPeerMap *peer_ids;
+
+/**
+ * Map from (hashes of) client handles to the numbers we use for
+ * them in the trace, stored as `uintptr_t` values.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *client_ids;
+
+
+/**
+ * Get the number identifying @a peer in the trace.
+ *
+ * @param peer the peer
+ * @return trace number of @a peer
+ */
+static unsigned int
+get_peer_id (const struct GNUNET_PeerIdentity *peer)
+{
+  uintptr_t id;
+
+  id = (uintptr_t) GNUNET_CONTAINER_multipeermap_get (peer_ids,
+                                                      peer);
+  if (0 != id)
+    return (unsigned int) id;
+  id = GNUNET_CONTAINER_multipeermap_size (peer_ids) + 1;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multipeermap_put (peer_ids,
+                                                    peer,
+                                                    (void *) id,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return (unsigned int) id;
+}
+
+
+/**
+ * Get the number identifying @a client in the trace.  Note that
+ * the handle of a client that disconnected may be reused for a new
+ * client, which then shares the number.
+ *
+ * @param client the client
+ * @return trace number of @a client
+ */
+static unsigned int
+get_client_id (const struct GNUNET_SERVER_Client *client)
+{
+  struct GNUNET_HashCode key;
+  uintptr_t id;
+
+  GNUNET_CRYPTO_hash (&client,
+                      sizeof (client),
+                      &key);
+  id = (uintptr_t) GNUNET_CONTAINER_multihashmap_get (client_ids,
+                                                      &key);
+  if (0 != id)
+    return (unsigned int) id;
+  id = GNUNET_CONTAINER_multihashmap_size (client_ids) + 1;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (client_ids,
+                                                    &key,
+                                                    (void *) id,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return (unsigned int) id;
+}
+
+
+/**
+ * Append an event to the trace, prefixed with the time.
+ *
+ * @param format format string for the event
+ * @param ... arguments for @a format
+ */
+static void
+trace_event (const char *format,
+             ...)
+{
+  char line[256];
+  va_list va;
+  int off;
+  int n;
+
+  off = GNUNET_snprintf (line,
+                         sizeof (line),
+                         "%llu ",
+                         (unsigned long long) GNUNET_TIME_absolute_get_duration (trace_start).rel_value_us);
+  va_start (va, format);
+  n = VSNPRINTF (&line[off],
+                 sizeof (line) - off - 1,
+                 format,
+                 va);
+  va_end (va);
+  if ( (n < 0) ||
+       (n >= (int) (sizeof (line) - off - 1)) )
+  {
+    GNUNET_break (0);
+    return;
+  }
+  off += n;
+  line[off++] = '\n';
+  if (GNUNET_OK !=
+      GNUNET_BIO_write (trace,
+                        line,
+                        off))
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Failed to write to trace file `%s', stopping trace\n"),
+         trace_fn);
+    GAS_trace_done ();
+  }
+}
+
+
+/**
+ * Start recording events if configured.
+ *
+ * @param cfg configuration to use
+ */
+void
+GAS_trace_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "ats",
+                                               "TRACE_FILE",
+                                               &trace_fn))
+    return;
+  trace = GNUNET_BIO_write_open (trace_fn);
+  if (NULL == trace)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_WARNING,
+                               "ats",
+                               "TRACE_FILE",
+                               _("cannot open file for writing"));
+    GNUNET_free (trace_fn);
+    trace_fn = NULL;
+    return;
+  }
+  LOG (GNUNET_ERROR_TYPE_INFO,
+       "Recording solver events to `%s'\n",
+       trace_fn);
+  trace_start = GNUNET_TIME_absolute_get ();
+  peer_ids = GNUNET_CONTAINER_multipeermap_create (128,
+                                                   GNUNET_NO);
+  client_ids = GNUNET_CONTAINER_multihashmap_create (16,
+                                                     GNUNET_NO);
+}
+
+
+/**
+ * Stop recording events and close the trace.
+ */
+void
+GAS_trace_done ()
+{
+  if (NULL == trace)
+    return;
+  if (GNUNET_OK != GNUNET_BIO_write_close (trace))
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Failed to close trace file `%s'\n"),
+         trace_fn);
+  trace = NULL;
+  GNUNET_free (trace_fn);
+  trace_fn = NULL;
+  GNUNET_CONTAINER_multipeermap_destroy (peer_ids);
+  peer_ids = NULL;
+  GNUNET_CONTAINER_multihashmap_destroy (client_ids);
+  client_ids = NULL;
+}
+
+
+/**
+ * Record that an address was added.
+ *
+ * @param address the new address
+ */
+void
+GAS_trace_address_add (const struct ATS_Address *address)
+{
+  const struct GNUNET_ATS_Properties *prop = &address->properties;
+
+  if (NULL == trace)
+    return;
+  trace_event ("add %u %u %s %u %llu %u %u %u",
+               get_peer_id (&address->peer),
+               (unsigned int) address->session_id,
+               address->plugin,
+               (unsigned int) prop->scope,
+               (unsigned long long) prop->delay.rel_value_us,
+               prop->distance,
+               (unsigned int) prop->utilization_out,
+               (unsigned int) prop->utilization_in);
+}
+
+
+/**
+ * Record that the properties of an address changed.
+ *
+ * @param address the updated address
+ */
+void
+GAS_trace_address_update (const struct ATS_Address *address)
+{
+  const struct GNUNET_ATS_Properties *prop = &address->properties;
+
+  if (NULL == trace)
+    return;
+  trace_event ("update %u %u %llu %u %u %u",
+               get_peer_id (&address->peer),
+               (unsigned int) address->session_id,
+               (unsigned long long) prop->delay.rel_value_us,
+               prop->distance,
+               (unsigned int) prop->utilization_out,
+               (unsigned int) prop->utilization_in);
+}
+
+
+/**
+ * Record that an address was removed.
+ *
+ * @param address the address being removed
+ */
+void
+GAS_trace_address_delete (const struct ATS_Address *address)
+{
+  if (NULL == trace)
+    return;
+  trace_event ("del %u %u",
+               get_peer_id (&address->peer),
+               (unsigned int) address->session_id);
+}
+
+
+/**
+ * Record a preference change by a client.
+ *
+ * @param client the client changing its preference
+ * @param peer the peer the preference is for
+ * @param kind the kind of preference
+ * @param value the (absolute) change of the preference
+ */
+void
+GAS_trace_preference (const struct GNUNET_SERVER_Client *client,
+                      const struct GNUNET_PeerIdentity *peer,
+                      enum GNUNET_ATS_PreferenceKind kind,
+                      float value)
+{
+  if (NULL == trace)
+    return;
+  trace_event ("pref %u %u %u %f",
+               get_peer_id (peer),
+               get_client_id (client),
+               (unsigned int) kind,
+               (double) value);
+}
+
+
+/**
+ * Record that an address was requested for a peer.
+ *
+ * @param peer the peer
+ */
+void
+GAS_trace_request_start (const struct GNUNET_PeerIdentity *peer)
+{
+  if (NULL == trace)
+    return;
+  trace_event ("request %u",
+               get_peer_id (peer));
+}
+
+
+/**
+ * Record that an address is no longer requested for a peer.
+ *
+ * @param peer the peer
+ */
+void
+GAS_trace_request_stop (const struct GNUNET_PeerIdentity *peer)
+{
+  if (NULL == trace)
+    return;
+  trace_event ("request-stop %u",
+               get_peer_id (peer));
+}
+
+
+/* end of gnunet-service-ats_trace.c */
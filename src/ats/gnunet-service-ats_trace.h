@@ -0,0 +1,126 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file ats/gnunet-service-ats_trace.h
+ * @brief ats service, recording of the events driving the solver
+ * @author Christian Grothoff
+ *
+ * If the option "TRACE_FILE" is set in section "ats", every event
+ * that is passed on to the solver is appended to that file, so that
+ * it can be replayed against the solvers using
+ * `gnunet-ats-solver-eval -r`.  Each event is one line:
+ *
+ *   TIME add PEER ADDRESS PLUGIN NETWORK DELAY DISTANCE UTIL_OUT UTIL_IN
+ *   TIME update PEER ADDRESS DELAY DISTANCE UTIL_OUT UTIL_IN
+ *   TIME del PEER ADDRESS
+ *   TIME pref PEER CLIENT KIND VALUE
+ *   TIME request PEER
+ *   TIME request-stop PEER
+ *
+ * TIME is in microseconds since the trace was started, DELAY in
+ * microseconds.  PEER and CLIENT are small integers assigned in the
+ * order in which peers and clients appear, ADDRESS is the session ID,
+ * so the trace does not contain identities or addresses.
+ */
+#ifndef GNUNET_SERVICE_ATS_TRACE_H
+#define GNUNET_SERVICE_ATS_TRACE_H
+
+#include "gnunet_util_lib.h"
+#include "gnunet-service-ats_addresses.h"
+
+
+/**
+ * Start recording events if configured.
+ *
+ * @param cfg configuration to use
+ */
+void
+GAS_trace_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
+
+
+/**
+ * Stop recording events and close the trace.
+ */
+void
+GAS_trace_done (void);
+
+
+/**
+ * Record that an address was added.
+ *
+ * @param address the new address
+ */
+void
+GAS_trace_address_add (const struct ATS_Address *address);
+
+
+/**
+ * Record that the properties of an address changed.
+ *
+ * @param address the updated address
+ */
+void
+GAS_trace_address_update (const struct ATS_Address *address);
+
+
+/**
+ * Record that an address was removed.
+ *
+ * @param address the address being removed
+ */
+void
+GAS_trace_address_delete (const struct ATS_Address *address);
+
+
+/**
+ * Record a preference change by a client.
+ *
+ * @param client the client changing its preference
+ * @param peer the peer the preference is for
+ * @param kind the kind of preference
+ * @param value the (absolute) change of the preference
+ */
+void
+GAS_trace_preference (const struct GNUNET_SERVER_Client *client,
+                      const struct GNUNET_PeerIdentity *peer,
+                      enum GNUNET_ATS_PreferenceKind kind,
+                      float value);
+
+
+/**
+ * Record that an address was requested for a peer.
+ *
+ * @param peer the peer
+ */
+void
+GAS_trace_request_start (const struct GNUNET_PeerIdentity *peer);
+
+
+/**
+ * Record that an address is no longer requested for a peer.
+ *
+ * @param peer the peer
+ */
+void
+GAS_trace_request_stop (const struct GNUNET_PeerIdentity *peer);
+
+
+#endif
+/* end of gnunet-service-ats_trace.h */
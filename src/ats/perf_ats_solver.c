@@ -41,6 +41,38 @@
 #define DEFAULT_ATS_COUNT       2
 
 
+/**
+ * Predefined benchmark scenario.
+ */
+struct Scenario
+{
+  /**
+   * Name used to select the scenario on the command line.
+   */
+  const char *name;
+
+  /**
+   * Number of peers.
+   */
+  int peers;
+
+  /**
+   * Number of addresses per peer.
+   */
+  int addresses;
+};
+
+
+/**
+ * Scenarios tracking solve times for large numbers of addresses.
+ */
+static const struct Scenario scenarios[] = {
+  { "1k", 100, 10 },
+  { "10k", 1000, 10 },
+  { NULL, 0, 0 }
+};
+
+
 /**
  * Handle for statistics.
  */
@@ -126,6 +158,11 @@ struct PerfHandle
    */
   int opt_update_percent;
 
+  /**
+   * Name of the predefined scenario to run, NULL for none
+   */
+  char *opt_scenario;
+
   /**
    * Create gnuplot file
    */
@@ -1214,6 +1251,7 @@ run (void *cls, char * const *args, const char *cfgfile,
   struct GNUNET_CONFIGURATION_Handle *solver_cfg;
   unsigned long long quotas_in[GNUNET_ATS_NetworkTypeCount];
   unsigned long long quotas_out[GNUNET_ATS_NetworkTypeCount];
+  const struct Scenario *sc;
   int c;
   int c2;
 
@@ -1260,6 +1298,23 @@ run (void *cls, char * const *args, const char *cfgfile,
   }
   GNUNET_free (src_filename);
 
+  /* Predefined scenario */
+  if (NULL != ph.opt_scenario)
+  {
+    for (sc = scenarios; NULL != sc->name; sc++)
+      if (0 == strcmp (sc->name, ph.opt_scenario))
+        break;
+    if (NULL == sc->name)
+    {
+      fprintf (stderr, "Unknown scenario `%s'\n", ph.opt_scenario);
+      ret = 1;
+      return;
+    }
+    ph.N_peers_start = sc->peers;
+    ph.N_peers_end = sc->peers;
+    ph.N_address = sc->addresses;
+  }
+
   /* Calculcate peers */
   if ((0 == ph.N_peers_start) && (0 == ph.N_peers_end))
   {
@@ -1384,6 +1439,7 @@ main (int argc, char *argv[])
   ph.N_peers_end = 0;
   ph.N_address = 0;
   ph.ats_string = NULL;
+  ph.opt_scenario = NULL;
   ph.create_datafile = GNUNET_NO;
   ph.measure_updates = GNUNET_NO;
   ph.total_iterations = 1;
@@ -1404,6 +1460,9 @@ main (int argc, char *argv[])
       { 'p', "percentage", NULL,
           gettext_noop ("update a fix percentage of addresses"),
           1, &GNUNET_GETOPT_set_uint, &ph.opt_update_percent },
+      { 'S', "scenario", "NAME",
+          gettext_noop ("run a predefined scenario: 1k or 10k addresses"),
+          1, &GNUNET_GETOPT_set_string, &ph.opt_scenario },
       { 'd', "data", NULL,
           gettext_noop ("create data file"),
           0, &GNUNET_GETOPT_set_one, &ph.create_datafile},
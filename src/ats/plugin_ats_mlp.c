@@ -275,6 +275,11 @@ struct GAS_MLP_Handle
    */
   glp_iocp control_param_mlp;
 
+  /**
+   * Time budget for a complete solution process (LP and MIP)
+   */
+  struct GNUNET_TIME_Relative max_duration;
+
   /**
    * Peers with pending address requests
    */
@@ -332,6 +337,12 @@ struct GAS_MLP_Handle
    */
   int opt_dbg_intopt_presolver;
 
+  /**
+   * Start the LP solver from the basis of the previous problem
+   * when the problem has to be rebuilt
+   */
+  int opt_warm_start;
+
   /**
    * Print GLPK output
    */
@@ -462,7 +473,8 @@ struct MLP_information
  *    The quotas for each network segment are passed by addresses. MLP can be
  *    adapted using configuration settings and uses the following parameters:
  *      * MLP_MAX_DURATION:
- *        Maximum duration for a MLP solution procees (default: 3 sec.)
+ *        Maximum duration for a MLP solution procees, LP and MIP together
+ *        (default: 3 sec.)
  *      * MLP_MAX_ITERATIONS:
  *        Maximum number of iterations for a MLP solution process (default:
  *        1024)
@@ -1298,6 +1310,68 @@ mlp_create_problem (struct GAS_MLP_Handle *mlp)
 }
 
 
+/**
+ * Initialize the basis of the (rebuilt) problem from the basis of
+ * the previous problem, matching rows and columns by name.  Rows and
+ * columns not found in @a old are new: rows become basic, columns
+ * non-basic.  If the result is not a proper basis, an advanced
+ * initial basis is constructed instead.
+ *
+ * @param mlp the MLP handle with the new problem
+ * @param old the previous problem
+ * @return #GNUNET_YES if the basis of @a old could be reused
+ */
+static int
+mlp_restore_basis (struct GAS_MLP_Handle *mlp,
+                   glp_prob *old)
+{
+  glp_prob *prob = mlp->p.prob;
+  const char *name;
+  int rows;
+  int cols;
+  int basic;
+  int stat;
+  int i;
+  int j;
+
+  if ( (GLP_OPT != glp_get_status (old)) &&
+       (GLP_FEAS != glp_get_status (old)) )
+    return GNUNET_NO;
+  glp_create_index (old);
+  rows = glp_get_num_rows (prob);
+  cols = glp_get_num_cols (prob);
+  basic = 0;
+  for (i = 1; i <= rows; i++)
+  {
+    name = glp_get_row_name (prob, i);
+    j = (NULL == name) ? 0 : glp_find_row (old, name);
+    stat = (0 == j) ? GLP_BS : glp_get_row_stat (old, j);
+    glp_set_row_stat (prob, i, stat);
+    if (GLP_BS == stat)
+      basic++;
+  }
+  for (i = 1; i <= cols; i++)
+  {
+    name = glp_get_col_name (prob, i);
+    j = (NULL == name) ? 0 : glp_find_col (old, name);
+    stat = (0 == j) ? GLP_NL : glp_get_col_stat (old, j);
+    glp_set_col_stat (prob, i, stat);
+    if (GLP_BS == stat)
+      basic++;
+  }
+  if (basic != rows)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Previous basis does not fit rebuilt problem (%d/%d basic)\n",
+         basic,
+         rows);
+    glp_adv_basis (prob, 0);
+    return GNUNET_NO;
+  }
+  return GNUNET_YES;
+}
+
+
 /**
  * Solves the LP problem
  *
@@ -1310,6 +1384,18 @@ mlp_solve_lp_problem (struct GAS_MLP_Handle *mlp)
   int res = 0;
   int res_status = 0;
   res = glp_simplex(mlp->p.prob, &mlp->control_param_lp);
+  if ( (GLP_NO == mlp->control_param_lp.presolve) &&
+       ( (GLP_EBADB == res) ||
+         (GLP_ESING == res) ||
+         (GLP_ECOND == res) ) )
+  {
+    /* the basis we started from is unusable, start over */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Initial basis invalid (%s), retrying with advanced basis\n",
+         mlp_solve_to_string (res));
+    glp_adv_basis (mlp->p.prob, 0);
+    res = glp_simplex(mlp->p.prob, &mlp->control_param_lp);
+  }
   if (0 == res)
     LOG(GNUNET_ERROR_TYPE_DEBUG, "Solving LP problem: %s\n",
         mlp_solve_to_string (res));
@@ -1554,6 +1640,9 @@ GAS_mlp_solve_problem (void *solver)
   struct GNUNET_TIME_Relative dur_setup;
   struct GNUNET_TIME_Relative dur_lp;
   struct GNUNET_TIME_Relative dur_mlp;
+  struct GNUNET_TIME_Relative remaining;
+  glp_prob *old_prob;
+  int warm;
 
   GNUNET_assert(NULL != solver);
 
@@ -1588,17 +1677,38 @@ GAS_mlp_solve_problem (void *solver)
   {
     LOG(GNUNET_ERROR_TYPE_DEBUG, "Problem size changed, rebuilding\n");
     notify(mlp, GAS_OP_SOLVE_SETUP_START, GAS_STAT_SUCCESS, GAS_INFO_FULL);
+    /* keep the old problem around to warm start from its basis */
+    old_prob = NULL;
+    if ( (GNUNET_YES == mlp->opt_warm_start) &&
+         (GNUNET_NO == mlp->opt_dbg_intopt_presolver) )
+    {
+      old_prob = mlp->p.prob;
+      mlp->p.prob = NULL;
+    }
     mlp_delete_problem (mlp);
     if (GNUNET_SYSERR == mlp_create_problem (mlp))
       {
+        if (NULL != old_prob)
+          glp_delete_prob (old_prob);
         notify(mlp, GAS_OP_SOLVE_SETUP_STOP, GAS_STAT_FAIL, GAS_INFO_FULL);
         return GNUNET_SYSERR;
       }
+    warm = GNUNET_NO;
+    if (NULL != old_prob)
+    {
+      warm = mlp_restore_basis (mlp, old_prob);
+      glp_delete_prob (old_prob);
+    }
     notify(mlp, GAS_OP_SOLVE_SETUP_STOP, GAS_STAT_SUCCESS, GAS_INFO_FULL);
     if (GNUNET_NO == mlp->opt_dbg_intopt_presolver)
     {
-    mlp->control_param_lp.presolve = GLP_YES; /* LP presolver, we need lp solution */
+    /* LP presolver, we need lp solution; the presolver would
+       discard the basis we start from */
+    mlp->control_param_lp.presolve = (GNUNET_YES == warm) ? GLP_NO : GLP_YES;
     mlp->control_param_mlp.presolve = GNUNET_NO; /* No presolver, we have LP solution */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Rebuilt problem, %s\n",
+         (GNUNET_YES == warm) ? "reusing previous basis" : "solving from scratch");
     }
     else
     {
@@ -1610,6 +1720,9 @@ GAS_mlp_solve_problem (void *solver)
   else
   {
     LOG(GNUNET_ERROR_TYPE_DEBUG, "Problem was updated, resolving\n");
+    /* only coefficients changed, continue from the current basis */
+    if (GNUNET_NO == mlp->opt_dbg_intopt_presolver)
+      mlp->control_param_lp.presolve = GLP_NO;
   }
 
   /* Reset solution info */
@@ -1629,6 +1742,7 @@ GAS_mlp_solve_problem (void *solver)
         "Running LP solver %s\n",
         (GLP_YES == mlp->control_param_lp.presolve)? "with presolver": "without presolver");
     start_cur_op = GNUNET_TIME_absolute_get();
+    mlp->control_param_lp.tm_lim = mlp->max_duration.rel_value_us / 1000LL;
 
     /* Solve LP */
     /* Only for debugging:
@@ -1666,6 +1780,12 @@ GAS_mlp_solve_problem (void *solver)
     if (GNUNET_YES == mlp->opt_dbg_intopt_presolver)
       mlp->control_param_mlp.presolve = GNUNET_YES;
 
+    /* The MIP search gets what is left of the time budget */
+    remaining = GNUNET_TIME_relative_subtract (mlp->max_duration,
+                                               GNUNET_TIME_absolute_get_duration (start_total));
+    mlp->control_param_mlp.tm_lim = GNUNET_MAX (1LL,
+                                                remaining.rel_value_us / 1000LL);
+
     mip_res = glp_intopt (mlp->p.prob, &mlp->control_param_mlp);
     switch (mip_res)
     {
@@ -1709,8 +1829,17 @@ GAS_mlp_solve_problem (void *solver)
         break;
       case GLP_FEAS: /* solution is feasible but not proven optimal */
 
-        if ( (mlp->ps.mlp_gap <= mlp->pv.mip_gap) ||
-             (mlp->ps.lp_mlp_gap <= mlp->pv.lp_mip_gap) )
+        if (GLP_ETMLIM == mip_res)
+        {
+          /* out of time: better use what we have than nothing */
+          LOG (GNUNET_ERROR_TYPE_INFO,
+               "Time budget exceeded, using best feasible solution found: %s, %s\n",
+               mlp_solve_to_string (mip_res),
+               mlp_status_to_string (mip_status));
+          mip_res = GNUNET_OK;
+        }
+        else if ( (mlp->ps.mlp_gap <= mlp->pv.mip_gap) ||
+                  (mlp->ps.lp_mlp_gap <= mlp->pv.lp_mip_gap) )
         {
           LOG (GNUNET_ERROR_TYPE_INFO,
                  "Solution of MLP problem is feasible and solution within gap constraints: %s, %s\n",
@@ -2546,6 +2675,12 @@ libgnunet_plugin_ats_mlp_init (void *cls)
   {
     max_duration = MLP_MAX_EXEC_DURATION;
   }
+  mlp->max_duration = max_duration;
+
+  mlp->opt_warm_start = GNUNET_CONFIGURATION_get_value_yesno (env->cfg,
+     "ats", "MLP_WARM_START");
+  if (GNUNET_SYSERR == mlp->opt_warm_start)
+    mlp->opt_warm_start = GNUNET_YES;
 
   /* Get maximum number of iterations */
   if (GNUNET_OK != GNUNET_CONFIGURATION_get_value_size(env->cfg, "ats",
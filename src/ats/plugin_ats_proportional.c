@@ -51,6 +51,20 @@
 #define PROPORTIONALITY_FACTOR 2.0
 
 
+/**
+ * Default relative change of the bandwidth assigned to an address
+ * below which we do not bother transport with an update.
+ */
+#define PROP_UPDATE_THRESHOLD 0.05
+
+
+/**
+ * Default time window in which bandwidth updates for addresses that
+ * already have bandwidth assigned are coalesced.
+ */
+#define PROP_UPDATE_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 100)
+
+
 /**
  * Address information stored for the proportional solver in the
  * `solver_information` member of `struct GNUNET_ATS_Address`.
@@ -70,6 +84,16 @@ struct AddressWrapper
    */
   struct AddressWrapper *prev;
 
+  /**
+   * Next in DLL of active addresses of the network
+   */
+  struct AddressWrapper *next_active;
+
+  /**
+   * Previous in DLL of active addresses of the network
+   */
+  struct AddressWrapper *prev_active;
+
   /**
    * The address
    */
@@ -128,6 +152,16 @@ struct Network
    */
   struct AddressWrapper *tail;
 
+  /**
+   * Linked list of active addresses in this network: head
+   */
+  struct AddressWrapper *active_head;
+
+  /**
+   * Linked list of active addresses in this network: tail
+   */
+  struct AddressWrapper *active_tail;
+
   /**
    * Total inbound quota
    */
@@ -153,6 +187,18 @@ struct Network
    */
   unsigned int total_addresses;
 
+  /**
+   * #GNUNET_YES if bandwidth has to be redistributed once the
+   * solver is unlocked after a bulk operation.
+   */
+  int bulk_pending;
+
+  /**
+   * #GNUNET_YES if bandwidth updates for addresses in this network
+   * are waiting for the update task.
+   */
+  int update_pending;
+
 };
 
 
@@ -182,6 +228,22 @@ struct GAS_PROPORTIONAL_Handle
    */
   double stability_factor;
 
+  /**
+   * Relative change of an address' bandwidth below which we do
+   * not notify transport.
+   */
+  double update_threshold;
+
+  /**
+   * Time window in which bandwidth updates are coalesced.
+   */
+  struct GNUNET_TIME_Relative update_delay;
+
+  /**
+   * Task sending the coalesced bandwidth updates.
+   */
+  struct GNUNET_SCHEDULER_Task *update_task;
+
   /**
    * Bulk lock counter. If zero, we are not locked.
    */
@@ -227,27 +289,30 @@ is_bandwidth_available_in_network (struct Network *net,
 
 
 /**
- * Test if all peers in this network require connectivity at level at
- * least @a con.
+ * Find the lowest connectivity requirement of the peers with an
+ * active address in this network.
  *
  * @param s the solver handle
  * @param net the network type to check
- * @param con connection return value threshold to check
- * @return #GNUNET_YES or #GNUNET_NO
+ * @return lowest connectivity requirement, UINT_MAX if no address is active
  */
-static int
-all_require_connectivity (struct GAS_PROPORTIONAL_Handle *s,
-                          struct Network *net,
-                          unsigned int con)
+static unsigned int
+get_min_connectivity (struct GAS_PROPORTIONAL_Handle *s,
+                      struct Network *net)
 {
   struct AddressWrapper *aw;
+  unsigned int con;
+  unsigned int min;
 
-  for (aw = net->head; NULL != aw; aw = aw->next)
-    if (con >
-        s->env->get_connectivity (s->env->cls,
-                                  &aw->addr->peer))
-      return GNUNET_NO;
-  return GNUNET_YES;
+  min = UINT_MAX;
+  for (aw = net->active_head; NULL != aw; aw = aw->next_active)
+  {
+    con = s->env->get_connectivity (s->env->cls,
+                                    &aw->addr->peer);
+    if (con < min)
+      min = con;
+  }
+  return min;
 }
 
 
@@ -302,10 +367,8 @@ distribute_bandwidth (struct GAS_PROPORTIONAL_Handle *s,
      network */
   sum_relative_peer_prefences = 0.0;
   count_addresses = 0;
-  for (aw = net->head; NULL != aw; aw = aw->next)
+  for (aw = net->active_head; NULL != aw; aw = aw->next_active)
   {
-    if (GNUNET_YES != aw->addr->active)
-      continue;
     peer_relative_prefs = s->env->get_preferences (s->env->cls,
                                                    &aw->addr->peer);
     sum_relative_peer_prefences
@@ -344,15 +407,8 @@ distribute_bandwidth (struct GAS_PROPORTIONAL_Handle *s,
     s->prop_factor * sum_relative_peer_prefences;
   quota_out_used = 0;
   quota_in_used = 0;
-  for (aw = net->head; NULL != aw; aw = aw->next)
+  for (aw = net->active_head; NULL != aw; aw = aw->next_active)
   {
-    if (GNUNET_YES != aw->addr->active)
-    {
-      /* set to 0, just to be sure */
-      aw->calculated_quota_in = 0;
-      aw->calculated_quota_out = 0;
-      continue;
-    }
     peer_relative_prefs = s->env->get_preferences (s->env->cls,
                                                    &aw->addr->peer);
     peer_weight = 1.0
@@ -384,28 +440,135 @@ distribute_bandwidth (struct GAS_PROPORTIONAL_Handle *s,
 
 
 /**
- * Notify ATS service of bandwidth changes to addresses.
+ * Check if the bandwidth assigned to an address changed enough
+ * to notify transport.
+ *
+ * @param s solver handle
+ * @param old_bw bandwidth transport knows about
+ * @param new_bw newly calculated bandwidth
+ * @return #GNUNET_YES if the change exceeds the update threshold
+ */
+static int
+is_significant_change (const struct GAS_PROPORTIONAL_Handle *s,
+                       uint32_t old_bw,
+                       uint32_t new_bw)
+{
+  uint32_t diff;
+
+  diff = (old_bw > new_bw) ? old_bw - new_bw : new_bw - old_bw;
+  if (0 == diff)
+    return GNUNET_NO;
+  if (0 == old_bw)
+    return GNUNET_YES;
+  return (diff > s->update_threshold * old_bw) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Task sending the bandwidth updates that were coalesced.
+ *
+ * @param cls the solver handle
+ * @param tc scheduler context
+ */
+static void
+propagate_pending_updates (void *cls,
+                           const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Notify ATS service of bandwidth changes to addresses.  Addresses
+ * that just became active are notified immediately; changes to
+ * addresses that already have bandwidth are dropped if they are
+ * below the update threshold and otherwise, if @a coalesce is set,
+ * delayed by the update window so that several redistributions
+ * result in a single update.
  *
  * @param s solver handle
  * @param net the network to propagate changes in
+ * @param coalesce #GNUNET_YES to delay updates of addresses that
+ *        already have bandwidth
  */
 static void
 propagate_bandwidth (struct GAS_PROPORTIONAL_Handle *s,
-                     struct Network *net)
+                     struct Network *net,
+                     int coalesce)
 {
   struct AddressWrapper *cur;
+  int deferred;
 
-  for (cur = net->head; NULL != cur; cur = cur->next)
+  deferred = GNUNET_NO;
+  for (cur = net->active_head; NULL != cur; cur = cur->next_active)
   {
     if ( (cur->addr->assigned_bw_in == cur->calculated_quota_in) &&
          (cur->addr->assigned_bw_out == cur->calculated_quota_out) )
       continue;
+    if ( (0 != cur->addr->assigned_bw_in) ||
+         (0 != cur->addr->assigned_bw_out) )
+    {
+      if ( (GNUNET_NO ==
+            is_significant_change (s,
+                                   cur->addr->assigned_bw_in,
+                                   cur->calculated_quota_in)) &&
+           (GNUNET_NO ==
+            is_significant_change (s,
+                                   cur->addr->assigned_bw_out,
+                                   cur->calculated_quota_out)) )
+        continue; /* not worth an update */
+      if ( (GNUNET_YES == coalesce) &&
+           (0 != s->update_delay.rel_value_us) )
+      {
+        deferred = GNUNET_YES;
+        continue;
+      }
+    }
     cur->addr->assigned_bw_in = cur->calculated_quota_in;
     cur->addr->assigned_bw_out = cur->calculated_quota_out;
-    if (GNUNET_YES == cur->addr->active)
-      s->env->bandwidth_changed_cb (s->env->cls,
-                                    cur->addr);
+    s->env->bandwidth_changed_cb (s->env->cls,
+                                  cur->addr);
   }
+  if (GNUNET_NO == deferred)
+    return;
+  net->update_pending = GNUNET_YES;
+  if (NULL == s->update_task)
+    s->update_task = GNUNET_SCHEDULER_add_delayed (s->update_delay,
+                                                   &propagate_pending_updates,
+                                                   s);
+}
+
+
+/**
+ * Task sending the bandwidth updates that were coalesced.
+ *
+ * @param cls the solver handle
+ * @param tc scheduler context
+ */
+static void
+propagate_pending_updates (void *cls,
+                           const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GAS_PROPORTIONAL_Handle *s = cls;
+  struct Network *net;
+  unsigned int i;
+
+  s->update_task = NULL;
+  s->env->info_cb (s->env->cls,
+                   GAS_OP_SOLVE_UPDATE_NOTIFICATION_START,
+                   GAS_STAT_SUCCESS,
+                   GAS_INFO_PROP_ALL);
+  for (i = 0; i < s->env->network_count; i++)
+  {
+    net = &s->network_entries[i];
+    if (GNUNET_YES != net->update_pending)
+      continue;
+    net->update_pending = GNUNET_NO;
+    propagate_bandwidth (s,
+                         net,
+                         GNUNET_NO);
+  }
+  s->env->info_cb (s->env->cls,
+                   GAS_OP_SOLVE_UPDATE_NOTIFICATION_STOP,
+                   GAS_STAT_SUCCESS,
+                   GAS_INFO_PROP_ALL);
 }
 
 
@@ -425,6 +588,11 @@ distribute_bandwidth_in_network (struct GAS_PROPORTIONAL_Handle *s,
   if (0 != s->bulk_lock)
   {
     s->bulk_requests++;
+    if (NULL != n)
+      n->bulk_pending = GNUNET_YES;
+    else
+      for (i = 0; i < s->env->network_count; i++)
+        s->network_entries[i].bulk_pending = GNUNET_YES;
     return;
   }
   if (NULL != n)
@@ -449,7 +617,8 @@ distribute_bandwidth_in_network (struct GAS_PROPORTIONAL_Handle *s,
                      GAS_STAT_SUCCESS,
                      GAS_INFO_PROP_SINGLE);
     propagate_bandwidth (s,
-                         n);
+                         n,
+                         GNUNET_YES);
 
     s->env->info_cb (s->env->cls,
                      GAS_OP_SOLVE_UPDATE_NOTIFICATION_STOP,
@@ -478,7 +647,8 @@ distribute_bandwidth_in_network (struct GAS_PROPORTIONAL_Handle *s,
                      GAS_INFO_PROP_ALL);
     for (i = 0; i < s->env->network_count; i++)
       propagate_bandwidth (s,
-                           &s->network_entries[i]);
+                           &s->network_entries[i],
+                           GNUNET_YES);
     s->env->info_cb (s->env->cls,
                      GAS_OP_SOLVE_UPDATE_NOTIFICATION_STOP,
                      GAS_STAT_SUCCESS,
@@ -501,6 +671,17 @@ struct FindBestAddressCtx
    * The currently best address
    */
   struct ATS_Address *best;
+
+  /**
+   * Lowest connectivity requirement of the active addresses per
+   * network, see #get_min_connectivity(); computed once per lookup.
+   */
+  unsigned int min_con[GNUNET_ATS_NetworkTypeCount];
+
+  /**
+   * #GNUNET_YES if the respective entry in @e min_con was computed.
+   */
+  int min_con_valid[GNUNET_ATS_NetworkTypeCount];
 };
 
 
@@ -546,10 +727,14 @@ find_best_address_it (void *cls,
      in that network scope */
   con = ctx->s->env->get_connectivity (ctx->s->env->cls,
                                        key);
-  if (GNUNET_YES !=
-      all_require_connectivity (ctx->s,
-                                asi->network,
-                                con))
+  if (GNUNET_YES != ctx->min_con_valid[asi->network->type])
+  {
+    ctx->min_con[asi->network->type]
+      = get_min_connectivity (ctx->s,
+                              asi->network);
+    ctx->min_con_valid[asi->network->type] = GNUNET_YES;
+  }
+  if (con > ctx->min_con[asi->network->type])
     need--;
   /* test if minimum bandwidth for 'current' would be available */
   bw_available
@@ -634,6 +819,7 @@ get_best_address (struct GAS_PROPORTIONAL_Handle *s,
 {
   struct FindBestAddressCtx fba_ctx;
 
+  memset (&fba_ctx, 0, sizeof (fba_ctx));
   fba_ctx.best = NULL;
   fba_ctx.s = s;
   GNUNET_CONTAINER_multipeermap_get_multiple (addresses,
@@ -759,6 +945,10 @@ update_active_address (struct GAS_PROPORTIONAL_Handle *s,
          GNUNET_i2s (peer));
     asi_cur->activated = GNUNET_TIME_UNIT_ZERO_ABS;
     current_address->active = GNUNET_NO;
+    GNUNET_CONTAINER_MDLL_remove (active,
+                                  asi_cur->network->active_head,
+                                  asi_cur->network->active_tail,
+                                  asi_cur);
     current_address->assigned_bw_in = 0;
     current_address->assigned_bw_out = 0;
     address_decrement_active (s,
@@ -798,6 +988,10 @@ update_active_address (struct GAS_PROPORTIONAL_Handle *s,
   /* Mark address as active */
   best_address->active = GNUNET_YES;
   asi_best->activated = GNUNET_TIME_absolute_get ();
+  GNUNET_CONTAINER_MDLL_insert (active,
+                                asi_best->network->active_head,
+                                asi_best->network->active_tail,
+                                asi_best);
   asi_best->network->active_addresses++;
   s->active_addresses++;
   GNUNET_STATISTICS_update (s->env->stats,
@@ -822,12 +1016,11 @@ update_active_address (struct GAS_PROPORTIONAL_Handle *s,
        connectivity requirement */
     con_min = UINT32_MAX;
     aw_min = NULL;
-    for (aw = asi_best->network->head; NULL != aw; aw = aw->next)
+    for (aw = asi_best->network->active_head; NULL != aw; aw = aw->next_active)
     {
-      if ( (con_min >
-            (a_con = s->env->get_connectivity (s->env->cls,
-                                               &aw->addr->peer))) &&
-           (GNUNET_YES == aw->addr->active) )
+      if (con_min >
+          (a_con = s->env->get_connectivity (s->env->cls,
+                                             &aw->addr->peer)))
       {
         aw_min = aw;
         con_min = a_con;
@@ -837,7 +1030,7 @@ update_active_address (struct GAS_PROPORTIONAL_Handle *s,
     }
     update_active_address (s,
                            aw_min->addr,
-                           &aw->addr->peer);
+                           &aw_min->addr->peer);
   }
   distribute_bandwidth_in_network (s,
                                    asi_best->network);
@@ -859,11 +1052,19 @@ GAS_proportional_change_preference (void *solver,
                                     double pref_rel)
 {
   struct GAS_PROPORTIONAL_Handle *s = solver;
+  struct ATS_Address *active;
+  struct AddressWrapper *asi;
 
   if (GNUNET_ATS_PREFERENCE_BANDWIDTH != kind)
     return; /* we do not care */
+  /* only the network the peer is active in is affected */
+  active = get_active_address (s,
+                               peer);
+  if (NULL == active)
+    return;
+  asi = active->solver_information;
   distribute_bandwidth_in_network (s,
-                                   NULL);
+                                   asi->network);
 }
 
 
@@ -958,6 +1159,7 @@ static void
 GAS_proportional_bulk_stop (void *solver)
 {
   struct GAS_PROPORTIONAL_Handle *s = solver;
+  unsigned int i;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Unlocking solver from bulk operation ...\n");
@@ -972,9 +1174,15 @@ GAS_proportional_bulk_stop (void *solver)
   {
     LOG (GNUNET_ERROR_TYPE_INFO,
          "No lock pending, recalculating\n");
-    distribute_bandwidth_in_network (s,
-                                     NULL);
     s->bulk_requests = 0;
+    for (i = 0; i < s->env->network_count; i++)
+    {
+      if (GNUNET_YES != s->network_entries[i].bulk_pending)
+        continue;
+      s->network_entries[i].bulk_pending = GNUNET_NO;
+      distribute_bandwidth_in_network (s,
+                                       &s->network_entries[i]);
+    }
   }
 }
 
@@ -989,11 +1197,9 @@ static void
 GAS_proportional_address_property_changed (void *solver,
                                            struct ATS_Address *address)
 {
-  struct GAS_PROPORTIONAL_Handle *s = solver;
-  struct AddressWrapper *asi = address->solver_information;
-
-  distribute_bandwidth_in_network (s,
-                                   asi->network);
+  /* Bandwidth is distributed by preferences only; the properties
+     of an address do not influence the allocation, so there is
+     nothing to redistribute. */
 }
 
 
@@ -1128,6 +1334,35 @@ libgnunet_plugin_ats_proportional_init (void *cls)
   sf.s_del = &GAS_proportional_address_delete;
   sf.s_bulk_start = &GAS_proportional_bulk_start;
   sf.s_bulk_stop = &GAS_proportional_bulk_stop;
+  s->update_threshold = PROP_UPDATE_THRESHOLD;
+  if (GNUNET_SYSERR !=
+      GNUNET_CONFIGURATION_get_value_float (env->cfg,
+                                            "ats",
+                                            "PROP_UPDATE_THRESHOLD",
+                                            &f_tmp))
+  {
+    if ((f_tmp < 0.0) || (f_tmp >= 1.0))
+    {
+      LOG (GNUNET_ERROR_TYPE_ERROR,
+           _("Invalid %s configuration %f\n"),
+           "PROP_UPDATE_THRESHOLD",
+           f_tmp);
+    }
+    else
+    {
+      s->update_threshold = f_tmp;
+      LOG (GNUNET_ERROR_TYPE_INFO,
+           "Using %s of %.3f\n",
+           "PROP_UPDATE_THRESHOLD",
+           f_tmp);
+    }
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (env->cfg,
+                                           "ats",
+                                           "PROP_UPDATE_DELAY",
+                                           &s->update_delay))
+    s->update_delay = PROP_UPDATE_DELAY;
   s->stability_factor = PROP_STABILITY_FACTOR;
   if (GNUNET_SYSERR !=
       GNUNET_CONFIGURATION_get_value_float (env->cfg,
@@ -1215,6 +1450,11 @@ libgnunet_plugin_ats_proportional_done (void *cls)
   struct AddressWrapper *next;
   unsigned int c;
 
+  if (NULL != s->update_task)
+  {
+    GNUNET_SCHEDULER_cancel (s->update_task);
+    s->update_task = NULL;
+  }
   for (c = 0; c < s->env->network_count; c++)
   {
     GNUNET_break (0 == s->network_entries[c].total_addresses);
@@ -236,6 +236,64 @@ GNUNET_BLOCK_evaluate (struct GNUNET_BLOCK_Context *ctx,
 }
 
 
+/**
+ * Validate several replies to the same query at once.  Equivalent to
+ * calling #GNUNET_BLOCK_evaluate() for each reply in order (so
+ * duplicates within the batch are detected via @a bf), but looks up
+ * the plugin only once.
+ *
+ * @param ctx block contxt
+ * @param type block type
+ * @param eo evaluation options to control evaluation
+ * @param query original query (hash)
+ * @param bf pointer to bloom filter associated with query; possibly updated (!)
+ * @param bf_mutator mutation value for @a bf
+ * @param xquery extrended query data (can be NULL, depending on type)
+ * @param xquery_size number of bytes in @a xquery
+ * @param reply_count number of replies to validate
+ * @param reply_blocks array of @a reply_count responses to validate
+ * @param reply_block_sizes number of bytes in each of the @a reply_blocks
+ * @param results array of @a reply_count entries, set to the
+ *        characterization of each reply
+ */
+void
+GNUNET_BLOCK_evaluate_batch (struct GNUNET_BLOCK_Context *ctx,
+                             enum GNUNET_BLOCK_Type type,
+                             enum GNUNET_BLOCK_EvaluationOptions eo,
+                             const struct GNUNET_HashCode *query,
+                             struct GNUNET_CONTAINER_BloomFilter **bf,
+                             int32_t bf_mutator,
+                             const void *xquery,
+                             size_t xquery_size,
+                             unsigned int reply_count,
+                             const void *const *reply_blocks,
+                             const size_t *reply_block_sizes,
+                             enum GNUNET_BLOCK_EvaluationResult *results)
+{
+  struct GNUNET_BLOCK_PluginFunctions *plugin = find_plugin (ctx, type);
+  unsigned int i;
+
+  for (i = 0; i < reply_count; i++)
+  {
+    if (NULL == plugin)
+    {
+      results[i] = GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED;
+      continue;
+    }
+    results[i] = plugin->evaluate (plugin->cls,
+                                   type,
+                                   eo,
+                                   query,
+                                   bf,
+                                   bf_mutator,
+                                   xquery,
+                                   xquery_size,
+                                   reply_blocks[i],
+                                   reply_block_sizes[i]);
+  }
+}
+
+
 /**
  * Function called to obtain the key for a block.
  *
@@ -325,4 +383,167 @@ GNUNET_BLOCK_construct_bloomfilter (int32_t bf_mutator,
 }
 
 
+/**
+ * Check the hash of a reply against the reply bloom filter of a
+ * request and add it, creating the filter if necessary.  This is
+ * what most plugins do after they validated a reply.
+ *
+ * @param bf pointer to bloom filter associated with the query, can be NULL
+ * @param bf_mutator mutation value for @a bf
+ * @param reply_hash hash identifying the reply (usually of the whole block)
+ * @return #GNUNET_YES if the reply is a duplicate, #GNUNET_NO if not
+ */
+int
+GNUNET_BLOCK_check_reply_filter (struct GNUNET_CONTAINER_BloomFilter **bf,
+                                 int32_t bf_mutator,
+                                 const struct GNUNET_HashCode *reply_hash)
+{
+  struct GNUNET_HashCode mhash;
+
+  if (NULL == bf)
+    return GNUNET_NO;
+  GNUNET_BLOCK_mingle_hash (reply_hash, bf_mutator, &mhash);
+  if (NULL != *bf)
+  {
+    if (GNUNET_YES == GNUNET_CONTAINER_bloomfilter_test (*bf, &mhash))
+      return GNUNET_YES;
+  }
+  else
+  {
+    *bf = GNUNET_CONTAINER_bloomfilter_init (NULL, 8,
+                                             GNUNET_CONSTANTS_BLOOMFILTER_K);
+  }
+  GNUNET_CONTAINER_bloomfilter_add (*bf, &mhash);
+  return GNUNET_NO;
+}
+
+
+/**
+ * Entry in a verification cache.
+ */
+struct VerificationCacheEntry
+{
+  /**
+   * Hash of the block.
+   */
+  struct GNUNET_HashCode block_hash;
+
+  /**
+   * #GNUNET_OK if valid, #GNUNET_SYSERR if invalid, #GNUNET_NO for
+   * an unused slot.
+   */
+  int result;
+};
+
+
+/**
+ * Small cache of recent verification results.  Direct-mapped: each
+ * block hash has exactly one slot, a new result simply replaces
+ * whatever was there.
+ */
+struct GNUNET_BLOCK_VerificationCache
+{
+  /**
+   * Array of @e size slots.
+   */
+  struct VerificationCacheEntry *entries;
+
+  /**
+   * Number of slots.
+   */
+  unsigned int size;
+};
+
+
+/**
+ * Create a verification cache.
+ *
+ * @param size number of results to remember
+ * @return the cache
+ */
+struct GNUNET_BLOCK_VerificationCache *
+GNUNET_BLOCK_verification_cache_create (unsigned int size)
+{
+  struct GNUNET_BLOCK_VerificationCache *cache;
+
+  GNUNET_assert (size > 0);
+  cache = GNUNET_new (struct GNUNET_BLOCK_VerificationCache);
+  cache->size = size;
+  cache->entries = GNUNET_new_array (size, struct VerificationCacheEntry);
+  return cache;
+}
+
+
+/**
+ * Destroy a verification cache.
+ *
+ * @param cache cache to destroy
+ */
+void
+GNUNET_BLOCK_verification_cache_destroy (struct GNUNET_BLOCK_VerificationCache *cache)
+{
+  GNUNET_free (cache->entries);
+  GNUNET_free (cache);
+}
+
+
+/**
+ * Find the slot for a block in the verification cache.
+ *
+ * @param cache cache to use
+ * @param block_hash hash of the block
+ * @return the slot
+ */
+static struct VerificationCacheEntry *
+get_cache_slot (struct GNUNET_BLOCK_VerificationCache *cache,
+                const struct GNUNET_HashCode *block_hash)
+{
+  return &cache->entries[block_hash->bits[0] % cache->size];
+}
+
+
+/**
+ * Look up the result of verifying a block.
+ *
+ * @param cache cache to use
+ * @param block_hash hash of the complete block (including its signature)
+ * @return #GNUNET_OK if the block is known to be valid,
+ *         #GNUNET_SYSERR if it is known to be invalid,
+ *         #GNUNET_NO if we did not verify it recently
+ */
+int
+GNUNET_BLOCK_verification_cache_get (struct GNUNET_BLOCK_VerificationCache *cache,
+                                     const struct GNUNET_HashCode *block_hash)
+{
+  struct VerificationCacheEntry *e = get_cache_slot (cache, block_hash);
+
+  if ( (GNUNET_NO == e->result) ||
+       (0 != memcmp (&e->block_hash,
+                     block_hash,
+                     sizeof (struct GNUNET_HashCode))) )
+    return GNUNET_NO;
+  return e->result;
+}
+
+
+/**
+ * Remember the result of verifying a block.
+ *
+ * @param cache cache to use
+ * @param block_hash hash of the complete block (including its signature)
+ * @param result #GNUNET_OK if the block is valid, #GNUNET_SYSERR if not
+ */
+void
+GNUNET_BLOCK_verification_cache_put (struct GNUNET_BLOCK_VerificationCache *cache,
+                                     const struct GNUNET_HashCode *block_hash,
+                                     int result)
+{
+  struct VerificationCacheEntry *e = get_cache_slot (cache, block_hash);
+
+  GNUNET_assert (GNUNET_NO != result);
+  e->block_hash = *block_hash;
+  e->result = result;
+}
+
+
 /* end of block.c */
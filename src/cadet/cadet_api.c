@@ -1718,6 +1718,8 @@ GNUNET_CADET_channel_get_info (struct GNUNET_CADET_Channel *channel,
     case GNUNET_CADET_OPTION_NOBUFFER:
     case GNUNET_CADET_OPTION_RELIABLE:
     case GNUNET_CADET_OPTION_OOORDER:
+    case GNUNET_CADET_OPTION_MULTIPATH:
+    case GNUNET_CADET_OPTION_WINDOW:
       if (0 != (option & channel->options))
         bool_flag = GNUNET_YES;
       else
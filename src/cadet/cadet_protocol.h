@@ -384,6 +384,31 @@ struct GNUNET_CADET_ChannelManage
 };
 
 
+/**
+ * Channel ACK confirming the options of a channel created with
+ * #GNUNET_CADET_OPTION_WINDOW.  Other channels are ACKed with a
+ * plain `struct GNUNET_CADET_ChannelManage`, as peers without
+ * window support only accept that.
+ */
+struct GNUNET_CADET_ChannelAck
+{
+  /**
+   * Type: GNUNET_MESSAGE_TYPE_CADET_CHANNEL_ACK
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * ID of the channel
+   */
+  CADET_ChannelNumber chid GNUNET_PACKED;
+
+  /**
+   * Channel options accepted by the destination.
+   */
+  uint32_t opt GNUNET_PACKED;
+};
+
+
 /**
  * Message for cadet data traffic.
  */
@@ -411,8 +436,18 @@ struct GNUNET_CADET_Data
 };
 
 
+/**
+ * Maximum number of ranges appended to a #GNUNET_CADET_DataACK.
+ */
+#define GNUNET_CADET_MAX_ACK_RANGES 16
+
+
 /**
  * Message to acknowledge end-to-end data.
+ *
+ * On channels with #GNUNET_CADET_OPTION_WINDOW, followed by up to
+ * #GNUNET_CADET_MAX_ACK_RANGES struct GNUNET_CADET_DataACKRange
+ * for messages received beyond the range of @e futures.
  */
 struct GNUNET_CADET_DataACK
 {
@@ -440,6 +475,23 @@ struct GNUNET_CADET_DataACK
 };
 
 
+/**
+ * Range of message IDs received out of order (selective ACK).
+ */
+struct GNUNET_CADET_DataACKRange
+{
+  /**
+   * First message ID of the range.
+   */
+  uint32_t start GNUNET_PACKED;
+
+  /**
+   * Last message ID of the range (inclusive).
+   */
+  uint32_t end GNUNET_PACKED;
+};
+
+
 /**
  * Message to acknowledge cadet encrypted traffic.
  */
@@ -21,6 +21,11 @@
  * @file cadet/gnunet-cadet-profiler.c
  *
  * @brief Profiler for cadet experiments.
+ *
+ * Two modes: rounds of pings with a shrinking number of running peers, and
+ * a benchmark (-b) that pushes bulk or request-response traffic over a
+ * configurable number of tunnels and channels and prints the results
+ * (latency percentiles, goodput, CPU, CADET statistics) as JSON.
  */
 #include <stdio.h>
 #include "platform.h"
@@ -31,6 +36,8 @@
 
 #define PING 1
 #define PONG 2
+#define BENCH_DATA 3
+#define BENCH_ECHO 4
 
 
 /**
@@ -84,6 +91,53 @@ struct CadetPingMessage
   uint32_t round_number;
 };
 
+/**
+ * Message type for benchmark traffic, padded up to the benchmark size.
+ */
+struct CadetBenchMessage
+{
+  /**
+   * Header. Type BENCH_DATA/BENCH_ECHO.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Index of the benchmark channel.
+   */
+  uint32_t channel;
+
+  /**
+   * Message number in the channel.
+   */
+  uint32_t counter;
+
+  /**
+   * Time the message was sent.
+   */
+  struct GNUNET_TIME_AbsoluteNBO timestamp;
+};
+
+/**
+ * Traffic patterns for the benchmark mode.
+ */
+enum BenchMode
+{
+  /**
+   * Not benchmarking, ping rounds.
+   */
+  BENCH_OFF = 0,
+
+  /**
+   * Send as fast as flow control allows, measure one way latency.
+   */
+  BENCH_BULK,
+
+  /**
+   * Send one message and wait for the echo, measure round trip latency.
+   */
+  BENCH_RR
+};
+
 /**
  * Peer description.
  */
@@ -157,7 +211,74 @@ struct CadetPeer
 };
 
 /**
- * Duration of each round.
+ * Benchmark channel description.
+ */
+struct BenchChannel
+{
+  /**
+   * Peer that opened the channel.
+   */
+  struct CadetPeer *src;
+
+  /**
+   * Channel handle at @a src.
+   */
+  struct GNUNET_CADET_Channel *ch;
+
+  /**
+   * Pending transmission, if any.
+   */
+  struct GNUNET_CADET_TransmitHandle *th;
+
+  /**
+   * Task to send the next message.
+   */
+  struct GNUNET_SCHEDULER_Task *send_task;
+
+  /**
+   * Index in the bench array.
+   */
+  unsigned int index;
+
+  /**
+   * Number of messages sent.
+   */
+  unsigned int sent;
+
+  /**
+   * Number of echoes received (request-response only).
+   */
+  unsigned int received;
+};
+
+/**
+ * Aggregated statistic from the CADET services.
+ */
+struct BenchStat
+{
+  /**
+   * DLL next
+   */
+  struct BenchStat *next;
+
+  /**
+   * DLL prev
+   */
+  struct BenchStat *prev;
+
+  /**
+   * Name of the statistic.
+   */
+  char *name;
+
+  /**
+   * Sum over all peers.
+   */
+  uint64_t value;
+};
+
+/**
+ * Duration of each round (duration of the benchmark).
  */
 static struct GNUNET_TIME_Relative round_time;
 
@@ -241,6 +362,86 @@ static unsigned int peers_warmup;
  */
 static int test_finished;
 
+/**
+ * Benchmark traffic pattern, #BENCH_OFF for ping rounds.
+ */
+static enum BenchMode bench_mode;
+
+/**
+ * Options given for the benchmark channels, as in the command line.
+ */
+static const char *bench_options;
+
+/**
+ * Channel options for the benchmark channels.
+ */
+static enum GNUNET_CADET_ChannelOption bench_flags;
+
+/**
+ * Number of tunnels (source/destination pairs) to benchmark.
+ */
+static unsigned int bench_tunnels;
+
+/**
+ * Number of channels in each tunnel.
+ */
+static unsigned int bench_channels;
+
+/**
+ * Size of each benchmark message.
+ */
+static size_t bench_size;
+
+/**
+ * Benchmark channels, bench_tunnels * bench_channels.
+ */
+static struct BenchChannel *bench;
+
+/**
+ * Latency samples in microseconds.
+ */
+static uint64_t *bench_latency;
+
+/**
+ * Number of samples in bench_latency.
+ */
+static unsigned int bench_samples;
+
+/**
+ * Allocated size of bench_latency.
+ */
+static unsigned int bench_samples_max;
+
+/**
+ * Payload bytes delivered in the measured direction.
+ */
+static uint64_t bench_bytes;
+
+/**
+ * Start of the benchmark.
+ */
+static struct GNUNET_TIME_Absolute bench_start;
+
+/**
+ * Duration of the benchmark, set when finished.
+ */
+static struct GNUNET_TIME_Relative bench_elapsed;
+
+/**
+ * CPU time used at the start / during the benchmark.
+ */
+static unsigned long long bench_cpu;
+
+/**
+ * CADET statistics DLL head, summed over all peers.
+ */
+static struct BenchStat *bench_stats_head;
+
+/**
+ * CADET statistics DLL tail.
+ */
+static struct BenchStat *bench_stats_tail;
+
 
 /**
  * START THE TEST ITSELF, AS WE ARE CONNECTED TO THE CADET SERVICES.
@@ -286,6 +487,160 @@ get_index (struct CadetPeer *peer)
 }
 
 
+/**
+ * Get the CPU time used by us and our (terminated) children.
+ *
+ * The CADET services run in the testbed's processes, so this covers the
+ * client side of the traffic (API, IPC) unless the services are reaped.
+ *
+ * @return CPU time in microseconds
+ */
+static unsigned long long
+get_cpu_us ()
+{
+  unsigned long long ret;
+#if HAVE_GETRUSAGE
+  struct rusage ru;
+
+  ret = 0;
+  if (0 == getrusage (RUSAGE_SELF, &ru))
+    ret += ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec
+      + ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+  if (0 == getrusage (RUSAGE_CHILDREN, &ru))
+    ret += ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec
+      + ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+#else
+  ret = 0;
+#endif
+  return ret;
+}
+
+
+/**
+ * Compare two latency samples, for qsort.
+ *
+ * @param a First sample.
+ * @param b Second sample.
+ *
+ * @return Negative, zero or positive as in strcmp.
+ */
+static int
+cmp_latency (const void *a, const void *b)
+{
+  uint64_t la = *(const uint64_t *) a;
+  uint64_t lb = *(const uint64_t *) b;
+
+  if (la < lb)
+    return -1;
+  return (la > lb) ? 1 : 0;
+}
+
+
+/**
+ * Get a percentile of the (sorted) latency samples.
+ *
+ * @param p Percentile, between 0 and 1.
+ *
+ * @return Latency at percentile @a p, in microseconds.
+ */
+static uint64_t
+bench_percentile (double p)
+{
+  if (0 == bench_samples)
+    return 0;
+  return bench_latency[(unsigned int) ((bench_samples - 1) * p)];
+}
+
+
+/**
+ * Print a string as a JSON string literal.
+ *
+ * @param str String to print.
+ */
+static void
+print_json_string (const char *str)
+{
+  FPRINTF (stdout, "\"");
+  for (; '\0' != *str; str++)
+  {
+    if ('"' == *str || '\\' == *str)
+      FPRINTF (stdout, "\\%c", *str);
+    else if (0x20 > (unsigned char) *str)
+      FPRINTF (stdout, "\\u%04x", (unsigned char) *str);
+    else
+      FPRINTF (stdout, "%c", *str);
+  }
+  FPRINTF (stdout, "\"");
+}
+
+
+/**
+ * Print the benchmark results as a JSON object and free the statistics.
+ */
+static void
+bench_show_results (void)
+{
+  struct BenchStat *stat;
+  uint64_t sum;
+  double secs;
+  unsigned int i;
+
+  sum = 0;
+  for (i = 0; i < bench_samples; i++)
+    sum += bench_latency[i];
+  secs = bench_elapsed.rel_value_us / 1000000.0;
+  if (0.0 == secs)
+    secs = 1.0;
+
+  FPRINTF (stdout, "{\n");
+  FPRINTF (stdout, "  \"mode\": \"%s\",\n",
+           BENCH_BULK == bench_mode ? "bulk" : "rr");
+  FPRINTF (stdout, "  \"options\": ");
+  print_json_string (bench_options);
+  FPRINTF (stdout, ",\n");
+  FPRINTF (stdout, "  \"peers\": %llu,\n", peers_total);
+  FPRINTF (stdout, "  \"tunnels\": %u,\n", bench_tunnels);
+  FPRINTF (stdout, "  \"channels_per_tunnel\": %u,\n", bench_channels);
+  FPRINTF (stdout, "  \"message_size\": %u,\n", (unsigned int) bench_size);
+  FPRINTF (stdout, "  \"duration_us\": %llu,\n",
+           (unsigned long long) bench_elapsed.rel_value_us);
+  FPRINTF (stdout, "  \"messages\": %u,\n", bench_samples);
+  FPRINTF (stdout, "  \"bytes\": %llu,\n", (unsigned long long) bench_bytes);
+  FPRINTF (stdout, "  \"goodput_bytes_per_s\": %.2f,\n", bench_bytes / secs);
+  FPRINTF (stdout, "  \"messages_per_s\": %.2f,\n", bench_samples / secs);
+  FPRINTF (stdout, "  \"latency_us\": {\n");
+  FPRINTF (stdout, "    \"type\": \"%s\",\n",
+           BENCH_BULK == bench_mode ? "one-way" : "round-trip");
+  FPRINTF (stdout, "    \"mean\": %.2f,\n",
+           0 == bench_samples ? 0.0 : (double) sum / bench_samples);
+  FPRINTF (stdout, "    \"p50\": %llu,\n",
+           (unsigned long long) bench_percentile (0.5));
+  FPRINTF (stdout, "    \"p99\": %llu,\n",
+           (unsigned long long) bench_percentile (0.99));
+  FPRINTF (stdout, "    \"p999\": %llu,\n",
+           (unsigned long long) bench_percentile (0.999));
+  FPRINTF (stdout, "    \"max\": %llu\n",
+           (unsigned long long) bench_percentile (1.0));
+  FPRINTF (stdout, "  },\n");
+  FPRINTF (stdout, "  \"cpu_us\": %llu,\n", bench_cpu);
+  FPRINTF (stdout, "  \"cpu_us_per_message\": %.2f,\n",
+           0 == bench_samples ? 0.0 : (double) bench_cpu / bench_samples);
+  FPRINTF (stdout, "  \"cadet_statistics\": {");
+  for (stat = bench_stats_head; NULL != stat; stat = bench_stats_head)
+  {
+    FPRINTF (stdout, "\n    ");
+    print_json_string (stat->name);
+    FPRINTF (stdout, ": %llu%s", (unsigned long long) stat->value,
+             NULL == stat->next ? "\n  " : ",");
+    GNUNET_CONTAINER_DLL_remove (bench_stats_head, bench_stats_tail, stat);
+    GNUNET_free (stat->name);
+    GNUNET_free (stat);
+  }
+  FPRINTF (stdout, "}\n");
+  FPRINTF (stdout, "}\n");
+}
+
+
 /**
  * Show the results of the test (banwidth acheived) and log them to GAUGER
  */
@@ -339,6 +694,18 @@ disconnect_cadet_peers (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "disconnecting cadet service, called from line %ld\n", line);
   disconnect_task = NULL;
+  for (i = 0; NULL != bench && i < bench_tunnels * bench_channels; i++)
+  {
+    if (NULL != bench[i].send_task)
+      GNUNET_SCHEDULER_cancel (bench[i].send_task);
+    bench[i].send_task = NULL;
+    if (NULL != bench[i].th)
+      GNUNET_CADET_notify_transmit_ready_cancel (bench[i].th);
+    bench[i].th = NULL;
+    if (NULL != bench[i].ch)
+      GNUNET_CADET_channel_destroy (bench[i].ch);
+    bench[i].ch = NULL;
+  }
   for (i = 0; i < peers_total; i++)
   {
     if (NULL != peers[i].op)
@@ -404,6 +771,8 @@ stats_cont (void *cls, struct GNUNET_TESTBED_Operation *op, const char *emsg)
 {
   GNUNET_log (GNUNET_ERROR_TYPE_INFO, "... collecting statistics done.\n");
   GNUNET_TESTBED_operation_done (stats_op);
+  if (BENCH_OFF != bench_mode)
+    bench_show_results ();
 
   if (NULL != disconnect_task)
     GNUNET_SCHEDULER_cancel (disconnect_task);
@@ -429,11 +798,25 @@ stats_iterator (void *cls, const struct GNUNET_TESTBED_Peer *peer,
                 const char *subsystem, const char *name,
                 uint64_t value, int is_persistent)
 {
+  struct BenchStat *stat;
   uint32_t i;
 
   i = GNUNET_TESTBED_get_index (peer);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, " STATS %u - %s [%s]: %llu\n",
               i, subsystem, name, value);
+  if (BENCH_OFF == bench_mode || 0 != strcmp ("cadet", subsystem))
+    return GNUNET_OK;
+
+  for (stat = bench_stats_head; NULL != stat; stat = stat->next)
+    if (0 == strcmp (name, stat->name))
+      break;
+  if (NULL == stat)
+  {
+    stat = GNUNET_new (struct BenchStat);
+    stat->name = GNUNET_strdup (name);
+    GNUNET_CONTAINER_DLL_insert_tail (bench_stats_head, bench_stats_tail, stat);
+  }
+  stat->value += value;
 
   return GNUNET_OK;
 }
@@ -471,7 +854,16 @@ finish_profiler (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     return;
 
   test_finished = GNUNET_YES;
-  show_end_data();
+  if (BENCH_OFF == bench_mode)
+  {
+    show_end_data ();
+  }
+  else
+  {
+    bench_elapsed = GNUNET_TIME_absolute_get_duration (bench_start);
+    bench_cpu = get_cpu_us () - bench_cpu;
+    qsort (bench_latency, bench_samples, sizeof (uint64_t), &cmp_latency);
+  }
   GNUNET_SCHEDULER_add_now (&collect_stats, NULL);
 }
 
@@ -758,12 +1150,199 @@ pong_handler (void *cls, struct GNUNET_CADET_Channel *channel,
 }
 
 
+/**
+ * Record a benchmark message arriving at its final destination.
+ *
+ * @param msg Message received (data in bulk mode, echo in request-response).
+ */
+static void
+bench_record (const struct CadetBenchMessage *msg)
+{
+  struct GNUNET_TIME_Relative latency;
+
+  /* The first message on each channel waits for the tunnel and channel
+   * setup, which is not what we are measuring. */
+  if (0 == ntohl (msg->counter))
+    return;
+  latency =
+    GNUNET_TIME_absolute_get_duration (GNUNET_TIME_absolute_ntoh (msg->timestamp));
+  if (bench_samples == bench_samples_max)
+    GNUNET_array_grow (bench_latency, bench_samples_max,
+                       2 * bench_samples_max + 1024);
+  bench_latency[bench_samples++] = latency.rel_value_us;
+  bench_bytes += ntohs (msg->header.size);
+}
+
+
+/**
+ * @brief Send the next benchmark message on a channel.
+ *
+ * @param cls Closure (benchmark channel).
+ * @param tc Task context.
+ */
+static void
+bench_send (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Transmit benchmark data callback.
+ *
+ * @param cls Closure (benchmark channel).
+ * @param size Size of the buffer we have.
+ * @param buf Buffer to copy data to.
+ */
+static size_t
+tmt_rdy_bench (void *cls, size_t size, void *buf)
+{
+  struct BenchChannel *bc = cls;
+  struct CadetBenchMessage *msg = buf;
+
+  bc->th = NULL;
+  if (size < bench_size || NULL == buf)
+  {
+    GNUNET_break (GNUNET_YES == test_finished);
+    return 0;
+  }
+  memset (msg, 0, bench_size);
+  msg->header.size = htons (bench_size);
+  msg->header.type = htons (BENCH_DATA);
+  msg->channel = htonl (bc->index);
+  msg->counter = htonl (bc->sent++);
+  msg->timestamp = GNUNET_TIME_absolute_hton (GNUNET_TIME_absolute_get ());
+  if (BENCH_BULK == bench_mode)
+    bc->send_task = GNUNET_SCHEDULER_add_now (&bench_send, bc);
+
+  return bench_size;
+}
+
+
+static void
+bench_send (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct BenchChannel *bc = cls;
+
+  bc->send_task = NULL;
+  if ((GNUNET_SCHEDULER_REASON_SHUTDOWN & tc->reason) != 0
+      || GNUNET_YES == test_finished || NULL == bc->ch)
+    return;
+
+  bc->th = GNUNET_CADET_notify_transmit_ready (bc->ch, GNUNET_NO,
+                                               GNUNET_TIME_UNIT_FOREVER_REL,
+                                               bench_size,
+                                               &tmt_rdy_bench, bc);
+}
+
+
+/**
+ * Transmit benchmark echo callback.
+ *
+ * @param cls Closure (copy of the data message, to be freed).
+ * @param size Size of the buffer we have.
+ * @param buf Buffer to copy data to.
+ */
+static size_t
+tmt_rdy_echo (void *cls, size_t size, void *buf)
+{
+  struct GNUNET_MessageHeader *copy = cls;
+  size_t msg_size;
+
+  msg_size = ntohs (copy->size);
+  if (size < msg_size || NULL == buf)
+  {
+    GNUNET_free (copy);
+    return 0;
+  }
+  memcpy (buf, copy, msg_size);
+  GNUNET_free (copy);
+
+  return msg_size;
+}
+
+
+/**
+ * Function is called whenever a benchmark data message is received.
+ *
+ * @param cls closure (peer #, set from GNUNET_CADET_connect)
+ * @param channel connection to the other end
+ * @param channel_ctx place to store local state associated with the channel
+ * @param message the actual message
+ * @return GNUNET_OK to keep the connection open,
+ *         GNUNET_SYSERR to close it (signal serious error)
+ */
+int
+bench_data_handler (void *cls, struct GNUNET_CADET_Channel *channel,
+                    void **channel_ctx,
+                    const struct GNUNET_MessageHeader *message)
+{
+  struct GNUNET_MessageHeader *copy;
+
+  GNUNET_CADET_receive_done (channel);
+  if (ntohs (message->size) < sizeof (struct CadetBenchMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_YES == test_finished)
+    return GNUNET_OK;
+
+  if (BENCH_BULK == bench_mode)
+  {
+    bench_record ((const struct CadetBenchMessage *) message);
+    return GNUNET_OK;
+  }
+  copy = GNUNET_copy_message (message);
+  copy->type = htons (BENCH_ECHO);
+  GNUNET_CADET_notify_transmit_ready (channel, GNUNET_NO,
+                                      GNUNET_TIME_UNIT_FOREVER_REL,
+                                      ntohs (message->size),
+                                      &tmt_rdy_echo, copy);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Function is called whenever a benchmark echo message is received.
+ *
+ * @param cls closure (peer #, set from GNUNET_CADET_connect)
+ * @param channel connection to the other end
+ * @param channel_ctx place to store local state associated with the channel
+ * @param message the actual message
+ * @return GNUNET_OK to keep the connection open,
+ *         GNUNET_SYSERR to close it (signal serious error)
+ */
+int
+bench_echo_handler (void *cls, struct GNUNET_CADET_Channel *channel,
+                    void **channel_ctx,
+                    const struct GNUNET_MessageHeader *message)
+{
+  struct BenchChannel *bc = *channel_ctx;
+
+  GNUNET_CADET_receive_done (channel);
+  if (NULL == bc || ntohs (message->size) < sizeof (struct CadetBenchMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_YES == test_finished)
+    return GNUNET_OK;
+
+  bench_record ((const struct CadetBenchMessage *) message);
+  bc->received++;
+  if (NULL == bc->send_task && NULL == bc->th)
+    bc->send_task = GNUNET_SCHEDULER_add_now (&bench_send, bc);
+
+  return GNUNET_OK;
+}
+
+
 /**
  * Handlers, for diverse services
  */
 static struct GNUNET_CADET_MessageHandler handlers[] = {
   {&ping_handler, PING, sizeof (struct CadetPingMessage)},
   {&pong_handler, PONG, sizeof (struct CadetPingMessage)},
+  {&bench_data_handler, BENCH_DATA, 0},
+  {&bench_echo_handler, BENCH_ECHO, 0},
   {NULL, 0, 0}
 };
 
@@ -807,6 +1386,8 @@ incoming_channel (void *cls, struct GNUNET_CADET_Channel *channel,
   }
   GNUNET_assert (peer == peers[n].incoming);
   GNUNET_assert (peer->dest == &peers[n]);
+  if (BENCH_OFF != bench_mode)
+    return NULL; /* Several channels per tunnel, the source destroys them */
   GNUNET_log (GNUNET_ERROR_TYPE_INFO, "%u <= %u %p\n",
               n, get_index (peer), channel);
   peers[n].incoming_ch = channel;
@@ -829,11 +1410,21 @@ channel_cleaner (void *cls, const struct GNUNET_CADET_Channel *channel,
 {
   long n = (long) cls;
   struct CadetPeer *peer = &peers[n];
+  struct BenchChannel *bc;
 
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
               "Channel %p disconnected at peer %ld\n", channel, n);
   if (peer->ch == channel)
     peer->ch = NULL;
+  if (BENCH_OFF != bench_mode && NULL != channel_ctx)
+  {
+    bc = channel_ctx;
+    if (NULL != bc->send_task)
+      GNUNET_SCHEDULER_cancel (bc->send_task);
+    bc->send_task = NULL;
+    bc->th = NULL; /* Freed by the API along with the channel */
+    bc->ch = NULL;
+  }
 }
 
 
@@ -858,6 +1449,56 @@ select_random_peer (struct CadetPeer *peer)
   return &peers[r];
 }
 
+/**
+ * Start the benchmark: open the channels of each tunnel and start sending.
+ */
+static void
+start_bench (void)
+{
+  struct BenchChannel *bc;
+  struct CadetPeer *dest;
+  unsigned int i;
+  unsigned int j;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO, "Start benchmark\n");
+  bench = GNUNET_malloc (sizeof (struct BenchChannel)
+                         * bench_tunnels * bench_channels);
+  for (i = 0; i < bench_tunnels; i++)
+  {
+    dest = select_random_peer (&peers[i]);
+    peers[i].dest = dest;
+    for (j = 0; j < bench_channels; j++)
+    {
+      bc = &bench[i * bench_channels + j];
+      bc->index = i * bench_channels + j;
+      bc->src = &peers[i];
+      bc->ch = GNUNET_CADET_channel_create (peers[i].cadet, bc, &dest->id,
+                                            1, bench_flags);
+      if (NULL == bc->ch)
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "Channel %u failed\n", bc->index);
+        GNUNET_CADET_TEST_cleanup (test_ctx);
+        return;
+      }
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO, "%u => %u %p (channel %u)\n",
+                  i, get_index (dest), bc->ch, bc->index);
+      bc->send_task = GNUNET_SCHEDULER_add_delayed (delay_ms_rnd (100),
+                                                    &bench_send, bc);
+    }
+  }
+  bench_start = GNUNET_TIME_absolute_get ();
+  bench_cpu = get_cpu_us ();
+  if (NULL != disconnect_task)
+    GNUNET_SCHEDULER_cancel (disconnect_task);
+  disconnect_task =
+    GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_add (round_time,
+                                                            SHORT_TIME),
+                                  &disconnect_cadet_peers,
+                                  (void *) __LINE__);
+  GNUNET_SCHEDULER_add_delayed (round_time, &finish_profiler, NULL);
+}
+
+
 /**
  * START THE TEST ITSELF, AS WE ARE CONNECTED TO THE CADET SERVICES.
  *
@@ -877,6 +1518,11 @@ start_test (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   if ((GNUNET_SCHEDULER_REASON_SHUTDOWN & tc->reason) != 0)
     return;
 
+  if (BENCH_OFF != bench_mode)
+  {
+    start_bench ();
+    return;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_INFO, "Start profiler\n");
 
   flags = GNUNET_CADET_OPTION_DEFAULT;
@@ -1030,6 +1676,93 @@ tmain (void *cls,
 }
 
 
+/**
+ * Parse the command line for the benchmark mode.
+ *
+ * @param argc Number of arguments.
+ * @param argv Arguments, argv[1] being "-b".
+ *
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on invalid arguments.
+ */
+static int
+parse_bench_args (int argc, char *argv[])
+{
+  const char *o;
+
+  if (9 > argc)
+  {
+    fprintf (stderr, "usage: %s -b DURATION PEERS TUNNELS CHANNELS SIZE "
+             "bulk|rr OPTIONS [DO_WARMUP]\n", argv[0]);
+    fprintf (stderr, "  OPTIONS: U (unreliable) or any of R (reliable), "
+             "M (multipath), W (window)\n");
+    fprintf (stderr, "example: %s -b 30s 16 4 2 1024 bulk R Y\n", argv[0]);
+    return GNUNET_SYSERR;
+  }
+
+  if (GNUNET_OK != GNUNET_STRINGS_fancy_time_to_relative (argv[2], &round_time))
+  {
+    fprintf (stderr, "%s is not a valid time\n", argv[2]);
+    return GNUNET_SYSERR;
+  }
+  peers_total = atoll (argv[3]);
+  bench_tunnels = atoi (argv[4]);
+  bench_channels = atoi (argv[5]);
+  bench_size = atoi (argv[6]);
+  if (0 == bench_tunnels || 0 == bench_channels)
+  {
+    fprintf (stderr, "need at least one tunnel and one channel\n");
+    return GNUNET_SYSERR;
+  }
+  if (sizeof (struct CadetBenchMessage) > bench_size
+      || GNUNET_CONSTANTS_MAX_CADET_MESSAGE_SIZE < bench_size)
+  {
+    fprintf (stderr, "message size must be between %u and %u\n",
+             (unsigned int) sizeof (struct CadetBenchMessage),
+             (unsigned int) GNUNET_CONSTANTS_MAX_CADET_MESSAGE_SIZE);
+    return GNUNET_SYSERR;
+  }
+
+  if (0 == strcmp ("bulk", argv[7]))
+    bench_mode = BENCH_BULK;
+  else if (0 == strcmp ("rr", argv[7]))
+    bench_mode = BENCH_RR;
+  else
+  {
+    fprintf (stderr, "%s is not a valid mode (bulk, rr)\n", argv[7]);
+    return GNUNET_SYSERR;
+  }
+
+  bench_options = argv[8];
+  bench_flags = GNUNET_CADET_OPTION_DEFAULT;
+  for (o = bench_options; '\0' != *o; o++)
+  {
+    switch (*o)
+    {
+      case 'U':
+        break;
+      case 'R':
+        bench_flags |= GNUNET_CADET_OPTION_RELIABLE;
+        break;
+      case 'M':
+        bench_flags |= GNUNET_CADET_OPTION_RELIABLE
+                       | GNUNET_CADET_OPTION_MULTIPATH;
+        break;
+      case 'W':
+        bench_flags |= GNUNET_CADET_OPTION_RELIABLE
+                       | GNUNET_CADET_OPTION_WINDOW;
+        break;
+      default:
+        fprintf (stderr, "%c is not a valid option (U, R, M, W)\n", *o);
+        return GNUNET_SYSERR;
+    }
+  }
+
+  peers_pinging = bench_tunnels;
+  do_warmup = (10 > argc || argv[9][0] != 'N');
+  return GNUNET_OK;
+}
+
+
 /**
  * Main: start profiler.
  */
@@ -1041,28 +1774,40 @@ main (int argc, char *argv[])
 
   config_file = ".profiler.conf";
 
-  if (4 > argc)
+  if (1 < argc && 0 == strcmp ("-b", argv[1]))
   {
-    fprintf (stderr, "usage: %s ROUND_TIME PEERS PINGS [DO_WARMUP]\n", argv[0]);
-    fprintf (stderr, "example: %s 30s 16 1 Y\n", argv[0]);
-    return 1;
+    if (GNUNET_OK != parse_bench_args (argc, argv))
+      return 1;
   }
-
-  if (GNUNET_OK != GNUNET_STRINGS_fancy_time_to_relative (argv[1], &round_time))
+  else
   {
-    fprintf (stderr, "%s is not a valid time\n", argv[1]);
-    return 1;
+    if (4 > argc)
+    {
+      fprintf (stderr, "usage: %s ROUND_TIME PEERS PINGS [DO_WARMUP]\n",
+               argv[0]);
+      fprintf (stderr, "       %s -b DURATION PEERS TUNNELS CHANNELS SIZE "
+               "bulk|rr OPTIONS [DO_WARMUP]\n", argv[0]);
+      fprintf (stderr, "example: %s 30s 16 1 Y\n", argv[0]);
+      return 1;
+    }
+
+    if (GNUNET_OK != GNUNET_STRINGS_fancy_time_to_relative (argv[1],
+                                                            &round_time))
+    {
+      fprintf (stderr, "%s is not a valid time\n", argv[1]);
+      return 1;
+    }
+
+    peers_total = atoll (argv[2]);
+    peers_pinging = atoll (argv[3]);
+    do_warmup = (5 > argc || argv[4][0] != 'N');
   }
 
-  peers_total = atoll (argv[2]);
   if (2 > peers_total)
   {
-    fprintf (stderr, "%s peers is not valid (> 2)\n", argv[1]);
+    fprintf (stderr, "%llu peers is not valid (> 2)\n", peers_total);
     return 1;
   }
-  peers = GNUNET_malloc (sizeof (struct CadetPeer) * peers_total);
-
-  peers_pinging = atoll (argv[3]);
 
   if (peers_total < 2 * peers_pinging)
   {
@@ -1070,8 +1815,7 @@ main (int argc, char *argv[])
                 "not enough peers, total should be > 2 * peers_pinging\n");
     return 1;
   }
-
-  do_warmup = (5 > argc || argv[4][0] != 'N');
+  peers = GNUNET_malloc (sizeof (struct CadetPeer) * peers_total);
 
   ids = GNUNET_CONTAINER_multipeermap_create (2 * peers_total, GNUNET_YES);
   GNUNET_assert (NULL != ids);
@@ -1084,6 +1828,8 @@ main (int argc, char *argv[])
                         &incoming_channel, &channel_cleaner,
                         handlers, ports);
   GNUNET_free (peers);
+  GNUNET_free_non_null (bench);
+  GNUNET_array_grow (bench_latency, bench_samples_max, 0);
 
   return 0;
 }
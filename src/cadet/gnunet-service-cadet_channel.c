@@ -39,6 +39,38 @@
                                     GNUNET_TIME_UNIT_MILLISECONDS, 250)
 #define CADET_RETRANSMIT_MARGIN  4
 
+/**
+ * Receive window of reliable channels, in messages.
+ */
+#define CADET_WINDOW_SIZE        64
+
+/**
+ * Largest window of channels with #GNUNET_CADET_OPTION_WINDOW.
+ */
+#define CADET_WINDOW_MAX         1024
+
+/**
+ * Initial congestion window of channels with #GNUNET_CADET_OPTION_WINDOW.
+ */
+#define CADET_WINDOW_INITIAL     4
+
+/**
+ * How many messages received after a missing one make us retransmit
+ * it without waiting for the retransmission timer.
+ */
+#define CADET_FAST_RETRANSMIT    3
+
+/**
+ * After how many in order messages do we ACK on window channels.
+ */
+#define CADET_ACK_EVERY          2
+
+/**
+ * How long to delay an ACK on window channels.
+ */
+#define CADET_ACK_DELAY          GNUNET_TIME_relative_multiply(\
+                                    GNUNET_TIME_UNIT_MILLISECONDS, 20)
+
 
 /**
  * All the states a connection can be in.
@@ -195,6 +227,42 @@ struct CadetChannelReliability
      * How long does it usually take to get an ACK.
      */
   struct GNUNET_TIME_Relative       expected_delay;
+
+    /**
+     * Task to send a delayed DATA_ACK (window channels).
+     */
+  struct GNUNET_SCHEDULER_Task *   ack_task;
+
+    /**
+     * In order messages received since the last DATA_ACK.
+     */
+  unsigned int                      n_unacked;
+
+    /**
+     * Congestion window: how many messages may be unacknowledged.
+     */
+  unsigned int                      cwnd;
+
+    /**
+     * Slow start threshold for @e cwnd.
+     */
+  unsigned int                      ssthresh;
+
+    /**
+     * Messages ACK'd since @e cwnd was last grown (congestion avoidance).
+     */
+  unsigned int                      cwnd_acked;
+
+    /**
+     * Are we recovering from a fast retransmission?
+     */
+  int                               in_recovery;
+
+    /**
+     * Highest MID sent when the recovery started, it is over once
+     * this MID is ACK'd.
+     */
+  uint32_t                          recover;
 };
 
 
@@ -245,6 +313,24 @@ struct CadetChannel
      */
   int reliable;
 
+    /**
+     * Is reliable data striped over all connections of the tunnel?
+     */
+  int multipath;
+
+    /**
+     * Was the channel created with #GNUNET_CADET_OPTION_WINDOW?
+     */
+  int window;
+
+    /**
+     * Does the channel use a congestion window and selective ACKs?
+     * Only once the destination confirmed #GNUNET_CADET_OPTION_WINDOW
+     * in its CHANNEL_ACK: peers without window support drop MIDs
+     * beyond #CADET_WINDOW_SIZE.
+     */
+  int window_ok;
+
     /**
      * Last time the channel was used
      */
@@ -341,6 +427,16 @@ send_create (struct CadetChannel *ch);
 static void
 send_ack (struct CadetChannel *ch, int fwd);
 
+/**
+ * Acknowledge received data, right away or delayed.
+ *
+ * @param ch Channel this is about.
+ * @param fwd Is for FWD traffic? (ACK dest->owner)
+ * @param immediate Do not delay the ACK.
+ */
+static void
+channel_ack_data (struct CadetChannel *ch, int fwd, int immediate);
+
 
 
 /**
@@ -407,9 +503,9 @@ add_buffered_data (const struct GNUNET_CADET_Data *msg,
 
   rel->n_recv++;
 
-  // FIXME do something better than O(n), although n < 64...
-  // FIXME start from the end (most messages are the latest ones)
-  for (prev = rel->head_recv; NULL != prev; prev = prev->next)
+  // FIXME do something better than O(n), although n < window...
+  /* Start from the end: most messages are the latest ones */
+  for (prev = rel->tail_recv; NULL != prev; prev = prev->prev)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, " prev %u\n", prev->mid);
     if (prev->mid == mid)
@@ -418,22 +514,38 @@ add_buffered_data (const struct GNUNET_CADET_Data *msg,
       rel->n_recv--;
       return;
     }
-    else if (GC_is_pid_bigger (prev->mid, mid))
+    else if (GC_is_pid_bigger (mid, prev->mid))
     {
       LOG (GNUNET_ERROR_TYPE_DEBUG, " bingo!\n");
       copy = copy_message (msg, mid, rel);
-      GNUNET_CONTAINER_DLL_insert_before (rel->head_recv, rel->tail_recv,
-                                          prev, copy);
+      GNUNET_CONTAINER_DLL_insert_after (rel->head_recv, rel->tail_recv,
+                                         prev, copy);
       return;
     }
   }
   copy = copy_message (msg, mid, rel);
-  LOG (GNUNET_ERROR_TYPE_DEBUG, " insert at tail! (now: %u)\n", rel->n_recv);
-  GNUNET_CONTAINER_DLL_insert_tail (rel->head_recv, rel->tail_recv, copy);
+  LOG (GNUNET_ERROR_TYPE_DEBUG, " insert at head! (now: %u)\n", rel->n_recv);
+  GNUNET_CONTAINER_DLL_insert (rel->head_recv, rel->tail_recv, copy);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "add_buffered_data END\n");
 }
 
 
+/**
+ * Get the receive window of a channel.
+ *
+ * @param ch Channel.
+ *
+ * @return How many messages beyond the last in order one we accept.
+ */
+static unsigned int
+channel_window (const struct CadetChannel *ch)
+{
+  if (GNUNET_YES == ch->reliable && GNUNET_YES == ch->window_ok)
+    return CADET_WINDOW_MAX;
+  return CADET_WINDOW_SIZE;
+}
+
+
 /**
  * Add a destination client to a channel, initializing all data structures
  * in the channel and the client.
@@ -461,6 +573,8 @@ add_destination (struct CadetChannel *ch, struct CadetClient *c)
   ch->dest_rel->ch = ch;
   ch->dest_rel->expected_delay.rel_value_us = 0;
   ch->dest_rel->retry_timer = CADET_RETRANSMIT_TIME;
+  ch->dest_rel->cwnd = CADET_WINDOW_INITIAL;
+  ch->dest_rel->ssthresh = CADET_WINDOW_MAX;
 
   ch->dest = c;
 }
@@ -479,6 +593,10 @@ channel_set_options (struct CadetChannel *ch, uint32_t options)
   GNUNET_YES : GNUNET_NO;
   ch->reliable = (options & GNUNET_CADET_OPTION_RELIABLE) != 0 ?
   GNUNET_YES : GNUNET_NO;
+  ch->multipath = (options & GNUNET_CADET_OPTION_MULTIPATH) != 0 ?
+  GNUNET_YES : GNUNET_NO;
+  ch->window = (options & GNUNET_CADET_OPTION_WINDOW) != 0 ?
+  GNUNET_YES : GNUNET_NO;
 }
 
 
@@ -499,6 +617,10 @@ channel_get_options (struct CadetChannel *ch)
     options |= GNUNET_CADET_OPTION_NOBUFFER;
   if (ch->reliable)
     options |= GNUNET_CADET_OPTION_RELIABLE;
+  if (ch->multipath)
+    options |= GNUNET_CADET_OPTION_MULTIPATH;
+  if (ch->window)
+    options |= GNUNET_CADET_OPTION_WINDOW;
 
   return options;
 }
@@ -552,6 +674,8 @@ send_client_create (struct CadetChannel *ch)
   opt = 0;
   opt |= GNUNET_YES == ch->reliable ? GNUNET_CADET_OPTION_RELIABLE : 0;
   opt |= GNUNET_YES == ch->nobuffer ? GNUNET_CADET_OPTION_NOBUFFER : 0;
+  opt |= GNUNET_YES == ch->multipath ? GNUNET_CADET_OPTION_MULTIPATH : 0;
+  opt |= GNUNET_YES == ch->window ? GNUNET_CADET_OPTION_WINDOW : 0;
   GML_send_channel_create (ch->dest, ch->lid_dest, ch->port, opt,
                            GCT_get_destination (ch->t));
 
@@ -638,7 +762,7 @@ send_client_buffered_data (struct CadetChannel *ch,
       LOG (GNUNET_ERROR_TYPE_DEBUG, " free copy recv MID %u (%p), %u left\n",
            copy->mid, copy, rel->n_recv);
       GNUNET_free (copy);
-      GCCH_send_data_ack (ch, fwd);
+      channel_ack_data (ch, fwd, GNUNET_NO);
     }
     else
     {
@@ -751,6 +875,15 @@ channel_retransmit_message (void *cls,
   /* Message not found in the queue that we are going to use. */
   LOG (GNUNET_ERROR_TYPE_DEBUG, "RETRANSMIT MID %u\n", copy->mid);
 
+  if (GNUNET_YES == ch->window_ok)
+  {
+    /* Timeout: start over with slow start */
+    rel->ssthresh = GNUNET_MAX (rel->cwnd / 2, 2);
+    rel->cwnd = 1;
+    rel->cwnd_acked = 0;
+    rel->in_recovery = GNUNET_NO;
+  }
+
   GCCH_send_prebuilt_message (&payload->header, ch, fwd, copy);
   GNUNET_STATISTICS_update (stats, "# data retransmitted", 1, GNUNET_NO);
 }
@@ -909,14 +1042,20 @@ send_create (struct CadetChannel *ch)
 static void
 send_ack (struct CadetChannel *ch, int fwd)
 {
-  struct GNUNET_CADET_ChannelManage msg;
+  struct GNUNET_CADET_ChannelAck msg;
 
-  msg.header.size = htons (sizeof (msg));
+  /* only peers with window support create window channels, so only
+     they get the options confirmed */
+  if (GNUNET_YES == ch->window)
+    msg.header.size = htons (sizeof (struct GNUNET_CADET_ChannelAck));
+  else
+    msg.header.size = htons (sizeof (struct GNUNET_CADET_ChannelManage));
   msg.header.type = htons (GNUNET_MESSAGE_TYPE_CADET_CHANNEL_ACK);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  sending channel %s ack for channel %s\n",
        GC_f2s (fwd), GCCH_2s (ch));
 
   msg.chid = htonl (ch->gid);
+  msg.opt = htonl (channel_get_options (ch));
   GCCH_send_prebuilt_message (&msg.header, ch, !fwd, NULL);
 }
 
@@ -1014,6 +1153,11 @@ channel_rel_free_all (struct CadetChannelReliability *rel)
     GNUNET_SCHEDULER_cancel (rel->retry_task);
     rel->retry_task = NULL;
   }
+  if (NULL != rel->ack_task)
+  {
+    GNUNET_SCHEDULER_cancel (rel->ack_task);
+    rel->ack_task = NULL;
+  }
   GNUNET_free (rel);
 }
 
@@ -1091,6 +1235,175 @@ channel_rel_free_sent (struct CadetChannelReliability *rel,
 }
 
 
+/**
+ * Mark messages in selective ACK ranges as ACK'd.
+ *
+ * @param rel Reliability data.
+ * @param msg DataACK message, followed by ranges of ACK'd messages.
+ * @param n Number of ranges following @a msg, in ascending order.
+ *
+ * @return How many messages have been freed.
+ */
+static unsigned int
+channel_rel_free_ranges (struct CadetChannelReliability *rel,
+                         const struct GNUNET_CADET_DataACK *msg,
+                         unsigned int n)
+{
+  const struct GNUNET_CADET_DataACKRange *ranges;
+  struct CadetReliableMessage *copy;
+  struct CadetReliableMessage *next;
+  uint32_t start;
+  uint32_t end;
+  unsigned int i;
+  unsigned int r;
+
+  ranges = (const struct GNUNET_CADET_DataACKRange *) &msg[1];
+  copy = rel->head_sent;
+  for (i = 0, r = 0; i < n && NULL != copy; i++)
+  {
+    start = ntohl (ranges[i].start);
+    end = ntohl (ranges[i].end);
+    LOG (GNUNET_ERROR_TYPE_DEBUG, " range %u - %u\n", start, end);
+    while (NULL != copy && GC_is_pid_bigger (start, copy->mid))
+      copy = copy->next;
+    while (NULL != copy && GNUNET_NO == GC_is_pid_bigger (copy->mid, end))
+    {
+      next = copy->next;
+      GNUNET_break (GNUNET_YES != rel_message_free (copy, GNUNET_YES));
+      r++;
+      copy = next;
+    }
+  }
+  return r;
+}
+
+
+/**
+ * Get the highest message ID a DataACK confirms.
+ *
+ * @param msg DataACK message.
+ * @param n Number of ranges following @a msg.
+ *
+ * @return Highest MID ACK'd cumulatively, by bitfield or by range.
+ */
+static uint32_t
+get_highest_acked (const struct GNUNET_CADET_DataACK *msg, unsigned int n)
+{
+  const struct GNUNET_CADET_DataACKRange *ranges;
+  uint64_t futures;
+  uint32_t highest;
+
+  ranges = (const struct GNUNET_CADET_DataACKRange *) &msg[1];
+  if (0 < n)
+    return ntohl (ranges[n - 1].end);
+  highest = ntohl (msg->mid);
+  for (futures = msg->futures; 0 != futures; futures >>= 1)
+    highest++;
+  return highest;
+}
+
+
+/**
+ * Retransmit the oldest unacknowledged message of a window channel
+ * without waiting for the retransmission timer.
+ *
+ * @param ch Channel.
+ * @param rel Reliability data with the message to retransmit.
+ * @param fwd Is this about FWD traffic?
+ */
+static void
+channel_fast_retransmit (struct CadetChannel *ch,
+                         struct CadetChannelReliability *rel,
+                         int fwd)
+{
+  struct CadetReliableMessage *copy;
+  struct GNUNET_CADET_Data *payload;
+
+  copy = rel->head_sent;
+  if (NULL == copy || NULL != copy->chq)
+    return;
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "FAST RETRANSMIT MID %u\n", copy->mid);
+  payload = (struct GNUNET_CADET_Data *) &copy[1];
+  GCCH_send_prebuilt_message (&payload->header, ch, fwd, copy);
+  GNUNET_STATISTICS_update (stats, "# data fast retransmitted", 1, GNUNET_NO);
+}
+
+
+/**
+ * Update the congestion window of a window channel after a DataACK.
+ *
+ * Slow start and additive increase while no message is missing, the
+ * window is halved and the oldest message retransmitted when
+ * #CADET_FAST_RETRANSMIT newer messages have been ACK'd past it.
+ *
+ * @param ch Channel.
+ * @param rel Reliability data of the ACK'd direction.
+ * @param msg DataACK message.
+ * @param n Number of ranges following @a msg.
+ * @param acked How many messages @a msg freed.
+ * @param fwd Is this about FWD traffic?
+ */
+static void
+channel_window_update (struct CadetChannel *ch,
+                       struct CadetChannelReliability *rel,
+                       const struct GNUNET_CADET_DataACK *msg,
+                       unsigned int n,
+                       unsigned int acked,
+                       int fwd)
+{
+  uint32_t highest;
+  unsigned int i;
+
+  if (GNUNET_YES == rel->in_recovery &&
+      GNUNET_NO == GC_is_pid_bigger (rel->recover, ntohl (msg->mid)))
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG, "  recovery done at %u\n", rel->recover);
+    rel->in_recovery = GNUNET_NO;
+  }
+
+  if (GNUNET_NO == rel->in_recovery)
+  {
+    for (i = 0; i < acked && rel->cwnd < CADET_WINDOW_MAX; i++)
+    {
+      if (rel->cwnd < rel->ssthresh)
+      {
+        rel->cwnd++;
+      }
+      else if (++rel->cwnd_acked >= rel->cwnd)
+      {
+        rel->cwnd++;
+        rel->cwnd_acked = 0;
+      }
+    }
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "  cwnd %u, ssthresh %u\n",
+       rel->cwnd, rel->ssthresh);
+
+  if (NULL == rel->head_sent)
+    return;
+
+  if (GNUNET_YES == rel->in_recovery)
+  {
+    /* Partial ACK: the next message is missing as well. */
+    if (0 < acked)
+      channel_fast_retransmit (ch, rel, fwd);
+    return;
+  }
+
+  highest = get_highest_acked (msg, n);
+  if (GC_is_pid_bigger (highest,
+                        rel->head_sent->mid + CADET_FAST_RETRANSMIT - 1))
+  {
+    rel->ssthresh = GNUNET_MAX (rel->cwnd / 2, 2);
+    rel->cwnd = rel->ssthresh;
+    rel->cwnd_acked = 0;
+    rel->in_recovery = GNUNET_YES;
+    rel->recover = rel->mid_send - 1;
+    channel_fast_retransmit (ch, rel, fwd);
+  }
+}
+
+
 /**
  * Destroy a reliable message after it has been acknowledged, either by
  * direct mid ACK or bitfield. Updates the appropriate data structures and
@@ -1409,6 +1722,22 @@ GCCH_get_id (const struct CadetChannel *ch)
 }
 
 
+/**
+ * Should the reliable data of this channel be striped over all
+ * connections of its tunnel?
+ *
+ * @param ch Channel.
+ *
+ * @return #GNUNET_YES if the channel is reliable and multipath.
+ */
+int
+GCCH_is_multipath (const struct CadetChannel *ch)
+{
+  return (GNUNET_YES == ch->reliable && GNUNET_YES == ch->multipath) ?
+         GNUNET_YES : GNUNET_NO;
+}
+
+
 /**
  * Get the channel tunnel.
  *
@@ -1429,7 +1758,7 @@ GCCH_get_tunnel (const struct CadetChannel *ch)
  * @param ch Channel.
  * @param fwd Is query about FWD traffic?
  *
- * @return Free buffer space [0 - 64]
+ * @return Free buffer space [0 - receive window]
  */
 unsigned int
 GCCH_get_buffer (struct CadetChannel *ch, int fwd)
@@ -1446,11 +1775,11 @@ GCCH_get_buffer (struct CadetChannel *ch, int fwd)
   if (NULL == rel)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  rel is NULL: max\n");
-    return 64;
+    return channel_window (ch);
   }
 
   LOG (GNUNET_ERROR_TYPE_DEBUG, "   n_recv %d\n", rel->n_recv);
-  return (64 - rel->n_recv);
+  return (channel_window (ch) - rel->n_recv);
 }
 
 
@@ -1527,10 +1856,15 @@ GCCH_is_terminal (struct CadetChannel *ch, int fwd)
 void
 GCCH_send_data_ack (struct CadetChannel *ch, int fwd)
 {
-  struct GNUNET_CADET_DataACK msg;
+  char buf[sizeof (struct GNUNET_CADET_DataACK)
+           + GNUNET_CADET_MAX_ACK_RANGES
+             * sizeof (struct GNUNET_CADET_DataACKRange)];
+  struct GNUNET_CADET_DataACK *msg;
+  struct GNUNET_CADET_DataACKRange *ranges;
   struct CadetChannelReliability *rel;
   struct CadetReliableMessage *copy;
   unsigned int delta;
+  unsigned int n;
   uint64_t mask;
   uint32_t ack;
 
@@ -1539,13 +1873,21 @@ GCCH_send_data_ack (struct CadetChannel *ch, int fwd)
 
   rel = fwd ? ch->dest_rel : ch->root_rel;
   ack = rel->mid_recv - 1;
+  rel->n_unacked = 0;
+  if (NULL != rel->ack_task)
+  {
+    GNUNET_SCHEDULER_cancel (rel->ack_task);
+    rel->ack_task = NULL;
+  }
 
-  msg.header.type = htons (GNUNET_MESSAGE_TYPE_CADET_DATA_ACK);
-  msg.header.size = htons (sizeof (msg));
-  msg.chid = htonl (ch->gid);
-  msg.mid = htonl (ack);
+  msg = (struct GNUNET_CADET_DataACK *) buf;
+  ranges = (struct GNUNET_CADET_DataACKRange *) &msg[1];
+  msg->header.type = htons (GNUNET_MESSAGE_TYPE_CADET_DATA_ACK);
+  msg->chid = htonl (ch->gid);
+  msg->mid = htonl (ack);
 
-  msg.futures = 0LL;
+  msg->futures = 0LL;
+  n = 0;
   for (copy = rel->head_recv; NULL != copy; copy = copy->next)
   {
     if (copy->type != GNUNET_MESSAGE_TYPE_CADET_DATA)
@@ -1557,21 +1899,93 @@ GCCH_send_data_ack (struct CadetChannel *ch, int fwd)
     GNUNET_assert (GC_is_pid_bigger(copy->mid, ack));
     delta = copy->mid - (ack + 1);
     if (63 < delta)
-      break;
+    {
+      if (GNUNET_NO == ch->window_ok)
+        break;
+      /* Beyond the bitfield: selective ACK ranges */
+      if (0 < n && ntohl (ranges[n - 1].end) + 1 == copy->mid)
+      {
+        ranges[n - 1].end = htonl (copy->mid);
+        continue;
+      }
+      if (GNUNET_CADET_MAX_ACK_RANGES == n)
+        break;
+      ranges[n].start = htonl (copy->mid);
+      ranges[n].end = htonl (copy->mid);
+      n++;
+      continue;
+    }
     mask = 0x1LL << delta;
-    msg.futures |= mask;
+    msg->futures |= mask;
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          " setting bit for %u (delta %u) (%llX) -> %llX\n",
-         copy->mid, delta, mask, msg.futures);
+         copy->mid, delta, mask, msg->futures);
   }
-  LOG (GNUNET_ERROR_TYPE_INFO, "===> DATA_ACK for %u + %llX\n",
-       ack, msg.futures);
+  msg->header.size = htons (sizeof (struct GNUNET_CADET_DataACK)
+                            + n * sizeof (struct GNUNET_CADET_DataACKRange));
+  LOG (GNUNET_ERROR_TYPE_INFO, "===> DATA_ACK for %u + %llX (%u ranges)\n",
+       ack, msg->futures, n);
 
-  GCCH_send_prebuilt_message (&msg.header, ch, !fwd, NULL);
+  GCCH_send_prebuilt_message (&msg->header, ch, !fwd, NULL);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "send_data_ack END\n");
 }
 
 
+/**
+ * Send a delayed DATA_ACK.
+ *
+ * @param cls Closure (CadetChannelReliability of the receiving end).
+ * @param tc TaskContext.
+ */
+static void
+channel_delayed_ack (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct CadetChannelReliability *rel = cls;
+
+  rel->ack_task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+
+  GCCH_send_data_ack (rel->ch, rel == rel->ch->dest_rel);
+}
+
+
+/**
+ * Acknowledge received data, right away or delayed.
+ *
+ * Window channels ACK every #CADET_ACK_EVERY in order messages or after
+ * #CADET_ACK_DELAY, others ACK every message.
+ *
+ * @param ch Channel this is about.
+ * @param fwd Is for FWD traffic? (ACK dest->owner)
+ * @param immediate Do not delay the ACK (message out of order/duplicate).
+ */
+static void
+channel_ack_data (struct CadetChannel *ch, int fwd, int immediate)
+{
+  struct CadetChannelReliability *rel;
+
+  if (GNUNET_NO == ch->reliable)
+    return;
+  if (GNUNET_NO == ch->window_ok || GNUNET_YES == immediate)
+  {
+    GCCH_send_data_ack (ch, fwd);
+    return;
+  }
+
+  rel = fwd ? ch->dest_rel : ch->root_rel;
+  rel->n_unacked++;
+  if (CADET_ACK_EVERY <= rel->n_unacked)
+  {
+    GCCH_send_data_ack (ch, fwd);
+    return;
+  }
+  if (NULL == rel->ack_task)
+    rel->ack_task = GNUNET_SCHEDULER_add_delayed (CADET_ACK_DELAY,
+                                                  &channel_delayed_ack, rel);
+}
+
+
 /**
  * Allow a client to send us more data, in case it was choked.
  *
@@ -1602,7 +2016,13 @@ GCCH_allow_client (struct CadetChannel *ch, int fwd)
     }
     if (NULL != rel->head_sent)
     {
-      if (64 <= rel->mid_send - rel->head_sent->mid)
+      unsigned int window;
+
+      if (GNUNET_YES == ch->window_ok)
+        window = GNUNET_MIN (rel->cwnd, CADET_WINDOW_MAX);
+      else
+        window = CADET_WINDOW_SIZE;
+      if (window <= rel->mid_send - rel->head_sent->mid)
       {
         LOG (GNUNET_ERROR_TYPE_DEBUG, " too big MID gap! Wait for ACK.\n");
         return;
@@ -1672,6 +2092,9 @@ GCCH_debug (struct CadetChannel *ch, enum GNUNET_ErrorType level)
     LOG2 (level, "CHN   recv %d\n", ch->root_rel->n_recv);
     LOG2 (level, "CHN   MID r: %d, s: %d\n",
           ch->root_rel->mid_recv, ch->root_rel->mid_send);
+    if (GNUNET_YES == ch->window_ok)
+      LOG2 (level, "CHN   cwnd %u, ssthresh %u\n",
+            ch->root_rel->cwnd, ch->root_rel->ssthresh);
   }
   LOG2 (level, "CHN   dest %p/%p\n",
               ch->dest, ch->dest_rel);
@@ -1683,6 +2106,9 @@ GCCH_debug (struct CadetChannel *ch, enum GNUNET_ErrorType level)
     LOG2 (level, "CHN   recv %d\n", ch->dest_rel->n_recv);
     LOG2 (level, "CHN   MID r: %d, s: %d\n",
           ch->dest_rel->mid_recv, ch->dest_rel->mid_send);
+    if (GNUNET_YES == ch->window_ok)
+      LOG2 (level, "CHN   cwnd %u, ssthresh %u\n",
+            ch->dest_rel->cwnd, ch->dest_rel->ssthresh);
 
   }
 }
@@ -1898,6 +2324,8 @@ GCCH_handle_local_create (struct CadetClient *c,
   ch->root_rel->ch = ch;
   ch->root_rel->retry_timer = CADET_RETRANSMIT_TIME;
   ch->root_rel->expected_delay.rel_value_us = 0;
+  ch->root_rel->cwnd = CADET_WINDOW_INITIAL;
+  ch->root_rel->ssthresh = CADET_WINDOW_MAX;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG, "CREATED CHANNEL %s\n", GCCH_2s (ch));
 
@@ -1925,6 +2353,7 @@ GCCH_handle_data (struct CadetChannel *ch,
   struct CadetChannelReliability *rel;
   struct CadetClient *c;
   uint32_t mid;
+  int immediate;
 
   /* If this is a remote (non-loopback) channel, find 'fwd'. */
   if (GNUNET_SYSERR == fwd)
@@ -1971,9 +2400,10 @@ GCCH_handle_data (struct CadetChannel *ch,
   LOG (GNUNET_ERROR_TYPE_INFO, "<=== DATA %u %s on channel %s\n",
        mid, GC_f2s (fwd), GCCH_2s (ch));
 
+  immediate = GNUNET_YES;
   if (GNUNET_NO == ch->reliable ||
       ( !GC_is_pid_bigger (rel->mid_recv, mid) &&
-        GC_is_pid_bigger (rel->mid_recv + 64, mid) ) )
+        GC_is_pid_bigger (rel->mid_recv + channel_window (ch), mid) ) )
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "RECV MID %u (%u)\n",
          mid, ntohs (msg->header.size));
@@ -1983,6 +2413,8 @@ GCCH_handle_data (struct CadetChannel *ch,
       if (mid == rel->mid_recv)
       {
         LOG (GNUNET_ERROR_TYPE_DEBUG, "as expected, sending to client\n");
+        /* ACK a filled gap right away */
+        immediate = (NULL != rel->head_recv) ? GNUNET_YES : GNUNET_NO;
         send_client_data (ch, msg, fwd);
       }
       else
@@ -2006,7 +2438,8 @@ GCCH_handle_data (struct CadetChannel *ch,
       GNUNET_break_op (0);
       LOG (GNUNET_ERROR_TYPE_WARNING,
           "MID %u on channel %s not expected (window: %u - %u). Dropping!\n",
-          mid, GCCH_2s (ch), rel->mid_recv, rel->mid_recv + 63);
+          mid, GCCH_2s (ch), rel->mid_recv,
+          rel->mid_recv + channel_window (ch) - 1);
     }
     else
     {
@@ -2023,7 +2456,7 @@ GCCH_handle_data (struct CadetChannel *ch,
     }
   }
 
-  GCCH_send_data_ack (ch, fwd);
+  channel_ack_data (ch, fwd, immediate);
 }
 
 
@@ -2045,6 +2478,9 @@ GCCH_handle_data_ack (struct CadetChannel *ch,
   struct CadetChannelReliability *rel;
   struct CadetReliableMessage *copy;
   struct CadetReliableMessage *next;
+  unsigned int n;
+  unsigned int acked;
+  unsigned int freed;
   uint32_t ack;
   int work;
 
@@ -2062,8 +2498,10 @@ GCCH_handle_data_ack (struct CadetChannel *ch,
   }
 
   ack = ntohl (msg->mid);
-  LOG (GNUNET_ERROR_TYPE_INFO, "<=== %s ACK %u + %llX\n",
-       GC_f2s (fwd), ack, msg->futures);
+  n = (ntohs (msg->header.size) - sizeof (struct GNUNET_CADET_DataACK))
+      / sizeof (struct GNUNET_CADET_DataACKRange);
+  LOG (GNUNET_ERROR_TYPE_INFO, "<=== %s ACK %u + %llX (%u ranges)\n",
+       GC_f2s (fwd), ack, msg->futures, n);
 
   if (GNUNET_YES == fwd)
     rel = ch->root_rel;
@@ -2077,16 +2515,22 @@ GCCH_handle_data_ack (struct CadetChannel *ch,
   }
 
   /* Free ACK'd copies: no need to retransmit those anymore FIXME refactor */
+  acked = 0;
   for (work = GNUNET_NO, copy = rel->head_sent; copy != NULL; copy = next)
   {
     if (GC_is_pid_bigger (copy->mid, ack))
     {
       LOG (GNUNET_ERROR_TYPE_DEBUG, "  head %u, out!\n", copy->mid);
-      if (0 < channel_rel_free_sent (rel, msg))
+      freed = channel_rel_free_sent (rel, msg);
+      if (GNUNET_YES == ch->window_ok)
+        freed += channel_rel_free_ranges (rel, msg, n);
+      if (0 < freed)
         work = GNUNET_YES;
+      acked += freed;
       break;
     }
     work = GNUNET_YES;
+    acked++;
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  id %u\n", copy->mid);
     next = copy->next;
     if (GNUNET_YES == rel_message_free (copy, GNUNET_YES))
@@ -2096,6 +2540,9 @@ GCCH_handle_data_ack (struct CadetChannel *ch,
     }
   }
 
+  if (GNUNET_YES == ch->window_ok)
+    channel_window_update (ch, rel, msg, n, acked, fwd);
+
   /* ACK client if needed and possible */
   GCCH_allow_client (ch, fwd);
 
@@ -2156,6 +2603,8 @@ GCCH_handle_create (struct CadetTunnel *t,
     ch = channel_new (t, NULL, 0);
     ch->gid = chid;
     channel_set_options (ch, ntohl (msg->opt));
+    /* we confirm the window in our CHANNEL_ACK */
+    ch->window_ok = ch->window;
     new_channel = GNUNET_YES;
   }
   else
@@ -2263,6 +2712,11 @@ GCCH_handle_ack (struct CadetChannel *ch,
     fwd = (NULL != ch->dest) ? GNUNET_YES : GNUNET_NO;
   }
 
+  if ( (GNUNET_YES == ch->window) &&
+       (ntohs (msg->header.size) >= sizeof (struct GNUNET_CADET_ChannelAck)) &&
+       (0 != (ntohl (((const struct GNUNET_CADET_ChannelAck *) msg)->opt)
+              & GNUNET_CADET_OPTION_WINDOW)) )
+    ch->window_ok = GNUNET_YES;
   channel_confirm (ch, !fwd);
 }
 
@@ -72,6 +72,17 @@ GCCH_destroy (struct CadetChannel *ch);
 CADET_ChannelNumber
 GCCH_get_id (const struct CadetChannel *ch);
 
+/**
+ * Should the reliable data of this channel be striped over all
+ * connections of its tunnel?
+ *
+ * @param ch Channel.
+ *
+ * @return #GNUNET_YES if the channel is reliable and multipath.
+ */
+int
+GCCH_is_multipath (const struct CadetChannel *ch);
+
 /**
  * Get the channel tunnel.
  *
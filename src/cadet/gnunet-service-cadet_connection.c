@@ -252,6 +252,17 @@ struct CadetConnection
    */
   unsigned short create_retry;
 
+  /**
+   * When did we send the CONNECTION_CREATE (origin) or the SYNACK
+   * (destination) we are waiting to be answered, zero if none.
+   */
+  struct GNUNET_TIME_Absolute handshake_sent;
+
+  /**
+   * Smoothed round trip time of the path, zero if not yet known.
+   */
+  struct GNUNET_TIME_Relative rtt;
+
   /**
    * Task to check if connection has duplicates.
    */
@@ -954,6 +965,38 @@ is_fwd (const struct CadetConnection *c,
 }
 
 
+/**
+ * Update the round trip time of a connection with the time it took to
+ * answer our last handshake message.
+ *
+ * @param c Connection whose handshake message was answered.
+ */
+static void
+connection_update_rtt (struct CadetConnection *c)
+{
+  struct GNUNET_TIME_Relative time;
+
+  if (0 == c->handshake_sent.abs_value_us)
+    return;
+  time = GNUNET_TIME_absolute_get_duration (c->handshake_sent);
+  c->handshake_sent = GNUNET_TIME_UNIT_ZERO_ABS;
+  GNUNET_STATISTICS_observe (stats, "# connection handshake RTT (us)",
+                             time.rel_value_us, GNUNET_NO);
+  if (0 == c->rtt.rel_value_us)
+  {
+    c->rtt = time;
+  }
+  else
+  {
+    c->rtt.rel_value_us *= 7;
+    c->rtt.rel_value_us += time.rel_value_us;
+    c->rtt.rel_value_us /= 8;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "  rtt of %s is now %s\n", GCC_2s (c),
+       GNUNET_STRINGS_relative_time_to_string (c->rtt, GNUNET_YES));
+}
+
+
 /**
  * Sends a CONNECTION ACK message in reponse to a received CONNECTION_CREATE
  * or a first CONNECTION_ACK directed to us.
@@ -976,6 +1019,8 @@ send_connection_ack (struct CadetConnection *connection, int fwd)
                  sizeof (struct GNUNET_CADET_ConnectionACK),
                  connection, fwd, &conn_message_sent, NULL);
   connection->pending_messages++;
+  if (GNUNET_NO == fwd)
+    connection->handshake_sent = GNUNET_TIME_absolute_get ();
   if (CADET_TUNNEL_NEW == GCT_get_cstate (t))
     GCT_change_cstate (t, CADET_TUNNEL_WAITING);
   if (CADET_CONNECTION_READY != connection->state)
@@ -2136,6 +2181,7 @@ GCC_handle_confirm (void *cls,
       return GNUNET_OK;
     }
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  Connection (SYN)ACK for us!\n");
+    connection_update_rtt (c);
 
     /* If just created, cancel the short timeout and start a long one */
     if (CADET_CONNECTION_SENT == oldstate)
@@ -2161,6 +2207,7 @@ GCC_handle_confirm (void *cls,
       return GNUNET_OK;
     }
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  Connection ACK for us!\n");
+    connection_update_rtt (c);
 
     /* If just created, cancel the short timeout and start a long one */
     if (CADET_CONNECTION_ACK == oldstate)
@@ -3224,6 +3271,21 @@ GCC_get_qn (struct CadetConnection *c, int fwd)
 }
 
 
+/**
+ * Get the round trip time of the path of a connection, measured during
+ * the connection handshake.
+ *
+ * @param c Connection.
+ *
+ * @return Smoothed round trip time, zero if not yet known.
+ */
+struct GNUNET_TIME_Relative
+GCC_get_rtt (const struct CadetConnection *c)
+{
+  return c->rtt;
+}
+
+
 /**
  * Get next PID to use.
  *
@@ -3607,6 +3669,7 @@ GCC_send_create (struct CadetConnection *connection)
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  C_P+ %p %u (create)\n",
        connection, connection->pending_messages);
   connection->pending_messages++;
+  connection->handshake_sent = GNUNET_TIME_absolute_get ();
 
   connection->maintenance_q =
     GCP_queue_add (get_next_hop (connection), NULL,
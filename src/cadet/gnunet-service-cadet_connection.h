@@ -409,6 +409,17 @@ GCC_get_allowed (struct CadetConnection *c, int fwd);
 unsigned int
 GCC_get_qn (struct CadetConnection *c, int fwd);
 
+/**
+ * Get the round trip time of the path of a connection, measured during
+ * the connection handshake.
+ *
+ * @param c Connection.
+ *
+ * @return Smoothed round trip time, zero if not yet known.
+ */
+struct GNUNET_TIME_Relative
+GCC_get_rtt (const struct CadetConnection *c);
+
 /**
  * Get next PID to use.
  *
@@ -38,11 +38,49 @@
 #define LOG(level, ...) GNUNET_log_from (level,"cadet-p2p",__VA_ARGS__)
 #define LOG2(level, ...) GNUNET_log_from_nocheck(level,"cadet-p2p",__VA_ARGS__)
 
+/**
+ * How many bytes of queued messages to ask core for in one go, so several
+ * small messages can share a single transmission.
+ */
+#define CADET_PEER_BATCH_SIZE 8192
+
 
 /******************************************************************************/
 /********************************   STRUCTS  **********************************/
 /******************************************************************************/
 
+/**
+ * Classes of queued messages, in order of precedence.
+ */
+enum CadetPeerQueueClass
+{
+  /**
+   * Connection level ACK and POLL, always sent first.
+   */
+  CADET_PEER_QUEUE_URGENT = 0,
+
+  /**
+   * Connection management and KX, not subject to flow control.
+   */
+  CADET_PEER_QUEUE_CONTROL = 1,
+
+  /**
+   * Encrypted payload going FWD, subject to per connection flow control.
+   */
+  CADET_PEER_QUEUE_DATA_FWD = 2,
+
+  /**
+   * Encrypted payload going BCK, subject to per connection flow control.
+   */
+  CADET_PEER_QUEUE_DATA_BCK = 3,
+
+  /**
+   * Number of classes.
+   */
+  CADET_PEER_QUEUE_CLASSES = 4
+};
+
+
 /**
  * Struct containing info about a queued transmission to this peer
  */
@@ -112,6 +150,82 @@ struct CadetPeerQueue
    * Closure for callback.
    */
   void *cont_cls;
+
+  /**
+   * Class of the message.
+   */
+  enum CadetPeerQueueClass qclass;
+
+  /**
+   * Connection queue holding the message, for payload classes.
+   */
+  struct CadetPeerConnectionQueue *cq;
+};
+
+
+/**
+ * Payload messages queued on one connection in one direction.
+ *
+ * Only the head of a connection queue can be sent, so the whole queue is
+ * either ready (in one of the peer's ready lists) or blocked waiting for
+ * an ACK (in the peer's blocked list).
+ */
+struct CadetPeerConnectionQueue
+{
+  /**
+   * DLL next
+   */
+  struct CadetPeerConnectionQueue *next;
+
+  /**
+   * DLL previous
+   */
+  struct CadetPeerConnectionQueue *prev;
+
+  /**
+   * Peer this queue belongs to.
+   */
+  struct CadetPeer *peer;
+
+  /**
+   * Connection the messages belong to.
+   */
+  struct CadetConnection *c;
+
+  /**
+   * Hash of the connection ID, key in the peer's map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Is FWD in c?
+   */
+  int fwd;
+
+  /**
+   * Class of the messages (#CADET_PEER_QUEUE_DATA_FWD or _BCK).
+   */
+  enum CadetPeerQueueClass qclass;
+
+  /**
+   * Messages DLL head.
+   */
+  struct CadetPeerQueue *head;
+
+  /**
+   * Messages DLL tail.
+   */
+  struct CadetPeerQueue *tail;
+
+  /**
+   * Bytes in all queued messages.
+   */
+  size_t bytes;
+
+  /**
+   * Is the queue in a ready list?
+   */
+  int ready;
 };
 
 
@@ -171,14 +285,57 @@ struct CadetPeer
   struct GNUNET_TIME_Absolute tmt_time;
 
   /**
-   * Transmission queue to core DLL head
+   * Transmission queues to core DLL head, by class.
+   * Only used for #CADET_PEER_QUEUE_URGENT and #CADET_PEER_QUEUE_CONTROL.
+   */
+  struct CadetPeerQueue *queue_head[CADET_PEER_QUEUE_CLASSES];
+
+  /**
+   * Transmission queues to core DLL tail, by class.
    */
-  struct CadetPeerQueue *queue_head;
+  struct CadetPeerQueue *queue_tail[CADET_PEER_QUEUE_CLASSES];
 
   /**
-   * Transmission queue to core DLL tail
+   * Connection queues allowed to send DLL head, by class.
+   * Only used for #CADET_PEER_QUEUE_DATA_FWD and #CADET_PEER_QUEUE_DATA_BCK,
+   * served round robin.
    */
-  struct CadetPeerQueue *queue_tail;
+  struct CadetPeerConnectionQueue *ready_head[CADET_PEER_QUEUE_CLASSES];
+
+  /**
+   * Connection queues allowed to send DLL tail, by class.
+   */
+  struct CadetPeerConnectionQueue *ready_tail[CADET_PEER_QUEUE_CLASSES];
+
+  /**
+   * Connection queues waiting for an ACK DLL head.
+   */
+  struct CadetPeerConnectionQueue *blocked_head;
+
+  /**
+   * Connection queues waiting for an ACK DLL tail.
+   */
+  struct CadetPeerConnectionQueue *blocked_tail;
+
+  /**
+   * Connection queues, indexed by connection hash (one per direction).
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *conn_queues;
+
+  /**
+   * Bitmask of classes that have something to send.
+   */
+  unsigned int queue_mask;
+
+  /**
+   * Payload class served last, to alternate between directions.
+   */
+  enum CadetPeerQueueClass last_data;
+
+  /**
+   * Bytes in messages that can be sent right away.
+   */
+  size_t sendable_bytes;
 
   /**
    * How many messages are in the queue to this peer.
@@ -246,6 +403,24 @@ static int in_shutdown;
 /*****************************     DEBUG      *********************************/
 /******************************************************************************/
 
+/**
+ * Log a queued message.
+ *
+ * @param q Queued message.
+ * @param level Error level to use for logging.
+ */
+static void
+queue_debug_message (const struct CadetPeerQueue *q,
+                     enum GNUNET_ErrorType level)
+{
+  LOG2 (level, "QQQ  - %s %s on %s\n",
+       GC_m2s (q->type), GC_f2s (q->fwd), GCC_2s (q->c));
+  LOG2 (level, "QQQ    payload %s, %u\n",
+       GC_m2s (q->payload_type), q->payload_id);
+  LOG2 (level, "QQQ    size: %u bytes\n", q->size);
+}
+
+
 /**
  * Log all kinds of info about the queueing status of a peer.
  *
@@ -256,7 +431,9 @@ static void
 queue_debug (const struct CadetPeer *p, enum GNUNET_ErrorType level)
 {
   struct GNUNET_TIME_Relative core_wait_time;
+  struct CadetPeerConnectionQueue *cq;
   struct CadetPeerQueue *q;
+  unsigned int qc;
   int do_log;
 
   do_log = GNUNET_get_log_call_status (level & (~GNUNET_ERROR_TYPE_BULK),
@@ -274,13 +451,26 @@ queue_debug (const struct CadetPeer *p, enum GNUNET_ErrorType level)
     LOG2 (level, "QQQ  core called %s ago\n",
           GNUNET_STRINGS_relative_time_to_string (core_wait_time, GNUNET_NO));
   }
-  for (q = p->queue_head; NULL != q; q = q->next)
+  LOG2 (level, "QQQ  sendable: %u bytes, mask %X\n",
+        p->sendable_bytes, p->queue_mask);
+  for (qc = 0; qc < CADET_PEER_QUEUE_CLASSES; qc++)
   {
-    LOG2 (level, "QQQ  - %s %s on %s\n",
-         GC_m2s (q->type), GC_f2s (q->fwd), GCC_2s (q->c));
-    LOG2 (level, "QQQ    payload %s, %u\n",
-         GC_m2s (q->payload_type), q->payload_id);
-    LOG2 (level, "QQQ    size: %u bytes\n", q->size);
+    for (q = p->queue_head[qc]; NULL != q; q = q->next)
+      queue_debug_message (q, level);
+    for (cq = p->ready_head[qc]; NULL != cq; cq = cq->next)
+    {
+      LOG2 (level, "QQQ  ready %s %s (%u bytes)\n",
+            GCC_2s (cq->c), GC_f2s (cq->fwd), cq->bytes);
+      for (q = cq->head; NULL != q; q = q->next)
+        queue_debug_message (q, level);
+    }
+  }
+  for (cq = p->blocked_head; NULL != cq; cq = cq->next)
+  {
+    LOG2 (level, "QQQ  blocked %s %s (%u bytes)\n",
+          GCC_2s (cq->c), GC_f2s (cq->fwd), cq->bytes);
+    for (q = cq->head; NULL != q; q = q->next)
+      queue_debug_message (q, level);
   }
 
   LOG2 (level, "QQQ End queue towards %s\n", GCP_2s (p));
@@ -751,6 +941,11 @@ peer_destroy (struct CadetPeer *peer)
     GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (peer->connections));
     GNUNET_CONTAINER_multihashmap_destroy (peer->connections);
   }
+  if (NULL != peer->conn_queues)
+  {
+    GNUNET_break (0 == GNUNET_CONTAINER_multihashmap_size (peer->conn_queues));
+    GNUNET_CONTAINER_multihashmap_destroy (peer->conn_queues);
+  }
   GNUNET_free_non_null (peer->hello);
   GNUNET_free (peer);
   return GNUNET_OK;
@@ -950,58 +1145,347 @@ peer_get_best_path (const struct CadetPeer *peer)
 
 
 /**
- * Is this queue element sendable?
+ * Get the class of a message to queue.
  *
- * - All management traffic is always sendable.
- * - For payload traffic, check the connection flow control.
+ * - ACK and POLL go before anything else.
+ * - All other management traffic is always sendable.
+ * - Payload traffic depends on the connection flow control.
  *
- * @param q Queue element to inspect.
- * @return #GNUNET_YES if it is sendable, #GNUNET_NO otherwise.
+ * @param type Type of the message.
+ * @param c Connection the message belongs to (can be NULL).
+ * @param fwd Is the message going FWD on @a c?
+ * @return Class of the message.
  */
-static int
-queue_is_sendable (struct CadetPeerQueue *q)
+static enum CadetPeerQueueClass
+queue_get_class (uint16_t type, const struct CadetConnection *c, int fwd)
 {
-  /* Is PID-independent? */
-  switch (q->type)
+  switch (type)
   {
     case GNUNET_MESSAGE_TYPE_CADET_ACK:
     case GNUNET_MESSAGE_TYPE_CADET_POLL:
-    case GNUNET_MESSAGE_TYPE_CADET_KX:
-    case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_CREATE:
-    case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_ACK:
-    case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_DESTROY:
-    case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_BROKEN:
-      return GNUNET_YES;
+      return CADET_PEER_QUEUE_URGENT;
 
     case GNUNET_MESSAGE_TYPE_CADET_ENCRYPTED:
     case GNUNET_MESSAGE_TYPE_CADET_AX:
-      break;
+      if (NULL != c)
+        return GNUNET_YES == fwd ? CADET_PEER_QUEUE_DATA_FWD :
+                                   CADET_PEER_QUEUE_DATA_BCK;
+      GNUNET_break (0);
+      return CADET_PEER_QUEUE_CONTROL;
 
     default:
-      GNUNET_break (0);
+      return CADET_PEER_QUEUE_CONTROL;
   }
+}
+
+
+/**
+ * Update the bit of a class in the mask of classes with sendable messages.
+ *
+ * @param peer Peer whose mask to update.
+ * @param qc Class that changed.
+ */
+static void
+queue_update_mask (struct CadetPeer *peer, enum CadetPeerQueueClass qc)
+{
+  int busy;
+
+  if (CADET_PEER_QUEUE_DATA_FWD > qc)
+    busy = (NULL != peer->queue_head[qc]);
+  else
+    busy = (NULL != peer->ready_head[qc]);
 
-  return GCC_is_sendable (q->c, q->fwd);
+  if (busy)
+    peer->queue_mask |= (1 << qc);
+  else
+    peer->queue_mask &= ~(1 << qc);
+}
+
+
+/**
+ * Closure for #conn_queue_match.
+ */
+struct CadetPeerConnQueueFind
+{
+  /**
+   * Connection to look for. Only compared, never dereferenced.
+   */
+  const struct CadetConnection *c;
+
+  /**
+   * Direction to look for.
+   */
+  int fwd;
+
+  /**
+   * Result, if found.
+   */
+  struct CadetPeerConnectionQueue *cq;
+};
+
+
+/**
+ * Iterator to find the queue of a connection in a given direction.
+ *
+ * @param cls Closure (`struct CadetPeerConnQueueFind`).
+ * @param key Connection hash.
+ * @param value Connection queue.
+ *
+ * @return #GNUNET_NO when found, #GNUNET_YES to keep iterating.
+ */
+static int
+conn_queue_match (void *cls,
+                  const struct GNUNET_HashCode *key,
+                  void *value)
+{
+  struct CadetPeerConnQueueFind *ctx = cls;
+  struct CadetPeerConnectionQueue *cq = value;
+
+  if (cq->c != ctx->c || cq->fwd != ctx->fwd)
+    return GNUNET_YES;
+  ctx->cq = cq;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Find the payload queue of a connection in a given direction.
+ *
+ * @param peer Neighbor the connection goes through.
+ * @param key Hash of the connection ID.
+ * @param c Connection (not dereferenced, can be already destroyed).
+ * @param fwd Direction.
+ *
+ * @return Connection queue, NULL if nothing is queued.
+ */
+static struct CadetPeerConnectionQueue *
+conn_queue_find (const struct CadetPeer *peer,
+                 const struct GNUNET_HashCode *key,
+                 const struct CadetConnection *c,
+                 int fwd)
+{
+  struct CadetPeerConnQueueFind ctx;
+
+  if (NULL == peer->conn_queues)
+    return NULL;
+  ctx.c = c;
+  ctx.fwd = fwd;
+  ctx.cq = NULL;
+  GNUNET_CONTAINER_multihashmap_get_multiple (peer->conn_queues, key,
+                                              &conn_queue_match, &ctx);
+  return ctx.cq;
+}
+
+
+/**
+ * Get the payload queue of a connection in a given direction, creating it
+ * (blocked) if needed.
+ *
+ * @param peer Neighbor the connection goes through.
+ * @param c Connection.
+ * @param fwd Direction.
+ *
+ * @return Connection queue.
+ */
+static struct CadetPeerConnectionQueue *
+conn_queue_get (struct CadetPeer *peer, struct CadetConnection *c, int fwd)
+{
+  struct CadetPeerConnectionQueue *cq;
+  struct GNUNET_HashCode key;
+
+  key = *GCC_get_h (c);
+  cq = conn_queue_find (peer, &key, c, fwd);
+  if (NULL != cq)
+    return cq;
+
+  if (NULL == peer->conn_queues)
+    peer->conn_queues = GNUNET_CONTAINER_multihashmap_create (8, GNUNET_NO);
+  cq = GNUNET_new (struct CadetPeerConnectionQueue);
+  cq->peer = peer;
+  cq->c = c;
+  cq->key = key;
+  cq->fwd = fwd;
+  cq->qclass = queue_get_class (GNUNET_MESSAGE_TYPE_CADET_AX, c, fwd);
+  cq->ready = GNUNET_NO;
+  GNUNET_CONTAINER_DLL_insert_tail (peer->blocked_head, peer->blocked_tail, cq);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (peer->conn_queues,
+                                                    &cq->key, cq,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  return cq;
+}
+
+
+/**
+ * Move a connection queue between the ready and blocked lists.
+ *
+ * @param cq Connection queue.
+ * @param ready Is the connection allowed to send now?
+ */
+static void
+conn_queue_set_ready (struct CadetPeerConnectionQueue *cq, int ready)
+{
+  struct CadetPeer *peer = cq->peer;
+
+  if (ready == cq->ready)
+    return;
+  if (GNUNET_YES == cq->ready)
+  {
+    GNUNET_CONTAINER_DLL_remove (peer->ready_head[cq->qclass],
+                                 peer->ready_tail[cq->qclass], cq);
+    GNUNET_CONTAINER_DLL_insert_tail (peer->blocked_head,
+                                      peer->blocked_tail, cq);
+    peer->sendable_bytes -= cq->bytes;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_remove (peer->blocked_head, peer->blocked_tail, cq);
+    GNUNET_CONTAINER_DLL_insert_tail (peer->ready_head[cq->qclass],
+                                      peer->ready_tail[cq->qclass], cq);
+    peer->sendable_bytes += cq->bytes;
+  }
+  cq->ready = ready;
+  queue_update_mask (peer, cq->qclass);
+}
+
+
+/**
+ * Destroy an empty connection queue.
+ *
+ * @param cq Connection queue.
+ */
+static void
+conn_queue_destroy (struct CadetPeerConnectionQueue *cq)
+{
+  struct CadetPeer *peer = cq->peer;
+
+  GNUNET_break (NULL == cq->head);
+  conn_queue_set_ready (cq, GNUNET_NO);
+  GNUNET_CONTAINER_DLL_remove (peer->blocked_head, peer->blocked_tail, cq);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (peer->conn_queues,
+                                                       &cq->key, cq));
+  GNUNET_free (cq);
+}
+
+
+/**
+ * Put a message in the queue of its class.
+ *
+ * @param peer Peer towards which the message goes.
+ * @param q Message to queue, with type, connection and size set.
+ */
+static void
+queue_link (struct CadetPeer *peer, struct CadetPeerQueue *q)
+{
+  struct CadetPeerConnectionQueue *cq;
+
+  q->qclass = queue_get_class (q->type, q->c, q->fwd);
+  if (CADET_PEER_QUEUE_DATA_FWD > q->qclass)
+  {
+    GNUNET_CONTAINER_DLL_insert_tail (peer->queue_head[q->qclass],
+                                      peer->queue_tail[q->qclass], q);
+    peer->sendable_bytes += q->size;
+    queue_update_mask (peer, q->qclass);
+    return;
+  }
+
+  cq = conn_queue_get (peer, q->c, q->fwd);
+  q->cq = cq;
+  GNUNET_CONTAINER_DLL_insert_tail (cq->head, cq->tail, q);
+  cq->bytes += q->size;
+  if (GNUNET_YES == cq->ready)
+    peer->sendable_bytes += q->size;
+  else
+    conn_queue_set_ready (cq, GCC_is_sendable (q->c, q->fwd));
+}
+
+
+/**
+ * Take a message out of the queue of its class.
+ *
+ * A connection that just sent goes to the back of its ready list, so
+ * connections sharing the link are served round robin.
+ *
+ * @param q Message to unqueue.
+ * @param sent Was the message sent (as opposed to cancelled)?
+ */
+static void
+queue_unlink (struct CadetPeerQueue *q, int sent)
+{
+  struct CadetPeer *peer = q->peer;
+  struct CadetPeerConnectionQueue *cq;
+
+  if (CADET_PEER_QUEUE_DATA_FWD > q->qclass)
+  {
+    GNUNET_CONTAINER_DLL_remove (peer->queue_head[q->qclass],
+                                 peer->queue_tail[q->qclass], q);
+    peer->sendable_bytes -= q->size;
+    queue_update_mask (peer, q->qclass);
+    return;
+  }
+
+  cq = q->cq;
+  GNUNET_CONTAINER_DLL_remove (cq->head, cq->tail, q);
+  cq->bytes -= q->size;
+  if (GNUNET_YES == cq->ready)
+    peer->sendable_bytes -= q->size;
+  if (GNUNET_YES == sent)
+    peer->last_data = cq->qclass;
+  if (NULL == cq->head)
+  {
+    conn_queue_destroy (cq);
+    return;
+  }
+  if (GNUNET_YES == sent && GNUNET_YES == cq->ready)
+  {
+    GNUNET_CONTAINER_DLL_remove (peer->ready_head[cq->qclass],
+                                 peer->ready_tail[cq->qclass], cq);
+    GNUNET_CONTAINER_DLL_insert_tail (peer->ready_head[cq->qclass],
+                                      peer->ready_tail[cq->qclass], cq);
+  }
 }
 
 
 /**
  * Get first sendable message.
  *
+ * Classes are served in order of precedence, payload alternates between
+ * directions. A connection that ran out of flow control window since it was
+ * made ready is moved to the blocked list here, when it is first noticed.
+ *
  * @param peer The destination peer.
  *
  * @return First transmittable message, if any. Otherwise, NULL.
  */
 static struct CadetPeerQueue *
-peer_get_first_message (const struct CadetPeer *peer)
+peer_get_first_message (struct CadetPeer *peer)
 {
-  struct CadetPeerQueue *q;
+  struct CadetPeerConnectionQueue *cq;
+  enum CadetPeerQueueClass qc;
+  unsigned int i;
+
+  if (0 == peer->queue_mask)
+    return NULL;
+  if (0 != (peer->queue_mask & (1 << CADET_PEER_QUEUE_URGENT)))
+    return peer->queue_head[CADET_PEER_QUEUE_URGENT];
+  if (0 != (peer->queue_mask & (1 << CADET_PEER_QUEUE_CONTROL)))
+    return peer->queue_head[CADET_PEER_QUEUE_CONTROL];
 
-  for (q = peer->queue_head; NULL != q; q = q->next)
+  qc = (CADET_PEER_QUEUE_DATA_FWD == peer->last_data) ?
+       CADET_PEER_QUEUE_DATA_BCK : CADET_PEER_QUEUE_DATA_FWD;
+  for (i = 0; i < 2; i++)
   {
-    LOG (GNUNET_ERROR_TYPE_DEBUG, "Checking q:%p on c:%s\n", q, GCC_2s (q->c));
-    if (queue_is_sendable (q))
-      return q;
+    while (NULL != (cq = peer->ready_head[qc]))
+    {
+      if (GNUNET_YES == GCC_is_sendable (cq->c, cq->fwd))
+        return cq->head;
+      LOG (GNUNET_ERROR_TYPE_DEBUG, "  %s %s blocked\n",
+           GCC_2s (cq->c), GC_f2s (cq->fwd));
+      conn_queue_set_ready (cq, GNUNET_NO);
+    }
+    qc = (CADET_PEER_QUEUE_DATA_FWD == qc) ?
+         CADET_PEER_QUEUE_DATA_BCK : CADET_PEER_QUEUE_DATA_FWD;
   }
 
   return NULL;
@@ -1058,6 +1542,27 @@ get_core_size (size_t message_size)
 }
 
 
+/**
+ * Get the size to ask core for, to send @a q and whatever else is sendable
+ * behind it, up to #CADET_PEER_BATCH_SIZE.
+ *
+ * @param peer Peer towards which to send.
+ * @param q First message to send.
+ *
+ * @return Size to request from core.
+ */
+static size_t
+get_core_request_size (const struct CadetPeer *peer,
+                       const struct CadetPeerQueue *q)
+{
+  size_t size;
+
+  size = GNUNET_MIN (peer->sendable_bytes, CADET_PEER_BATCH_SIZE);
+  size = GNUNET_MAX (size, q->size);
+  return get_core_size (size);
+}
+
+
 /**
  * Fill a core buffer with the appropriate data for the queued message.
  *
@@ -1176,7 +1681,7 @@ queue_send (void *cls, size_t size, void *buf)
                                             GNUNET_NO, get_priority (queue),
                                             GNUNET_TIME_UNIT_FOREVER_REL,
                                             dst_id,
-                                            get_core_size (queue->size),
+                                            get_core_request_size (peer, queue),
                                             &queue_send,
                                             peer);
       peer->tmt_time = GNUNET_TIME_absolute_get ();
@@ -1229,7 +1734,7 @@ queue_send (void *cls, size_t size, void *buf)
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  size %u ok (%u/%u)\n",
          queue->size, total_size, size);
 
-    msg_size = fill_buf (queue, (void *) dst, size, &pid);
+    msg_size = fill_buf (queue, (void *) dst, rest, &pid);
 
     if (0 < drop_percent &&
         GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, 101) < drop_percent)
@@ -1270,7 +1775,7 @@ queue_send (void *cls, size_t size, void *buf)
                                              GNUNET_NO, get_priority (queue),
                                              GNUNET_TIME_UNIT_FOREVER_REL,
                                              dst_id,
-                                             get_core_size (queue->size),
+                                             get_core_request_size (peer, queue),
                                              &queue_send,
                                              peer);
       peer->tmt_time = GNUNET_TIME_absolute_get ();
@@ -1351,7 +1856,7 @@ GCP_queue_destroy (struct CadetPeerQueue *queue,
              GC_m2s (queue->type));
     }
   }
-  GNUNET_CONTAINER_DLL_remove (peer->queue_head, peer->queue_tail, queue);
+  queue_unlink (queue, sent);
 
   if (queue->type != GNUNET_MESSAGE_TYPE_CADET_ACK &&
       queue->type != GNUNET_MESSAGE_TYPE_CADET_POLL)
@@ -1417,7 +1922,6 @@ GCP_queue_add (struct CadetPeer *peer,
                void *cont_cls)
 {
   struct CadetPeerQueue *q;
-  int priority;
   int call_core;
 
   GCC_check_connections ();
@@ -1435,18 +1939,6 @@ GCP_queue_add (struct CadetPeer *peer,
     return NULL;
   }
 
-  priority = 0;
-
-  if (GNUNET_MESSAGE_TYPE_CADET_POLL == type ||
-      GNUNET_MESSAGE_TYPE_CADET_ACK == type)
-  {
-    priority = 100;
-  }
-
-  LOG (GNUNET_ERROR_TYPE_DEBUG, "priority %d\n", priority);
-
-  call_core = (NULL == c || type == GNUNET_MESSAGE_TYPE_CADET_KX) ?
-               GNUNET_YES : GCC_is_sendable (c, fwd);
   q = GNUNET_new (struct CadetPeerQueue);
   q->cls = cls;
   q->type = type;
@@ -1458,16 +1950,15 @@ GCP_queue_add (struct CadetPeer *peer,
   q->fwd = fwd;
   q->cont = cont;
   q->cont_cls = cont_cls;
-  if (100 > priority)
-  {
-    GNUNET_CONTAINER_DLL_insert_tail (peer->queue_head, peer->queue_tail, q);
+  queue_link (peer, q);
+  if (CADET_PEER_QUEUE_URGENT != q->qclass)
     peer->queue_n++;
-  }
-  else
-  {
-    GNUNET_CONTAINER_DLL_insert (peer->queue_head, peer->queue_tail, q);
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "class %u\n", q->qclass);
+
+  if (CADET_PEER_QUEUE_DATA_FWD > q->qclass)
     call_core = GNUNET_YES;
-  }
+  else
+    call_core = q->cq->ready;
 
   q->start_waiting = GNUNET_TIME_absolute_get ();
   if (NULL == peer->core_transmit && GNUNET_YES == call_core)
@@ -1480,7 +1971,7 @@ GCP_queue_add (struct CadetPeer *peer,
                                            GNUNET_NO, get_priority (q),
                                            GNUNET_TIME_UNIT_FOREVER_REL,
                                            GNUNET_PEER_resolve2 (peer->id),
-                                           get_core_size (size),
+                                           get_core_request_size (peer, q),
                                            &queue_send, peer);
     peer->tmt_time = GNUNET_TIME_absolute_get ();
   }
@@ -1516,46 +2007,69 @@ void
 GCP_queue_cancel (struct CadetPeer *peer,
                   struct CadetConnection *c)
 {
+  struct CadetPeerConnectionQueue *cq;
   struct CadetPeerQueue *q;
   struct CadetPeerQueue *next;
   struct CadetPeerQueue *prev;
+  struct GNUNET_HashCode key;
+  unsigned int qc;
   int connection_destroyed;
+  int fwd;
 
   GCC_check_connections ();
   connection_destroyed = GNUNET_NO;
-  for (q = peer->queue_head; NULL != q; q = next)
+  key = *GCC_get_h (c);
+  for (qc = 0; qc < CADET_PEER_QUEUE_DATA_FWD; qc++)
   {
-    prev = q->prev;
-    if (q->c == c)
+    for (q = peer->queue_head[qc]; NULL != q; q = next)
     {
-      LOG (GNUNET_ERROR_TYPE_DEBUG,
-           "GMP queue cancel %s\n",
-           GC_m2s (q->type));
-      GNUNET_break (GNUNET_NO == connection_destroyed);
-      if (GNUNET_MESSAGE_TYPE_CADET_CONNECTION_DESTROY == q->type)
+      prev = q->prev;
+      if (q->c == c)
       {
-        q->c = NULL;
+        LOG (GNUNET_ERROR_TYPE_DEBUG,
+             "GMP queue cancel %s\n",
+             GC_m2s (q->type));
+        GNUNET_break (GNUNET_NO == connection_destroyed);
+        if (GNUNET_MESSAGE_TYPE_CADET_CONNECTION_DESTROY == q->type)
+        {
+          q->c = NULL;
+        }
+        else
+        {
+          connection_destroyed = GCP_queue_destroy (q, GNUNET_YES, GNUNET_NO, 0);
+        }
+
+        /* Get next from prev, q->next might be already freed:
+         * queue destroy -> callback -> GCC_destroy -> cancel_queues -> here
+         */
+        if (NULL == prev)
+          next = peer->queue_head[qc];
+        else
+          next = prev->next;
       }
       else
       {
-        connection_destroyed = GCP_queue_destroy (q, GNUNET_YES, GNUNET_NO, 0);
+        next = q->next;
       }
-
-      /* Get next from prev, q->next might be already freed:
-       * queue destroy -> callback -> GCC_destroy -> cancel_queues -> here
-       */
-      if (NULL == prev)
-        next = peer->queue_head;
-      else
-        next = prev->next;
     }
-    else
+  }
+
+  /* Look the connection queue up again after each message, the callback
+   * might have cancelled the rest already (and freed c, so use the key). */
+  for (fwd = GNUNET_NO; fwd <= GNUNET_YES; fwd++)
+  {
+    while (NULL != (cq = conn_queue_find (peer, &key, c, fwd)))
     {
-      next = q->next;
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "GMP queue cancel %s\n",
+           GC_m2s (cq->head->type));
+      GNUNET_break (GNUNET_NO == connection_destroyed);
+      connection_destroyed = GCP_queue_destroy (cq->head,
+                                                GNUNET_YES, GNUNET_NO, 0);
     }
   }
 
-  if ( (NULL == peer->queue_head) &&
+  if ( (NULL == peer_get_first_message (peer)) &&
        (NULL != peer->core_transmit) )
   {
     GNUNET_CORE_notify_transmit_ready_cancel (peer->core_transmit);
@@ -1566,35 +2080,6 @@ GCP_queue_cancel (struct CadetPeer *peer,
 }
 
 
-/**
- * Get the first transmittable message for a connection.
- *
- * @param peer Neighboring peer.
- * @param c Connection.
- *
- * @return First transmittable message.
- */
-static struct CadetPeerQueue *
-connection_get_first_message (struct CadetPeer *peer, struct CadetConnection *c)
-{
-  struct CadetPeerQueue *q;
-
-  for (q = peer->queue_head; NULL != q; q = q->next)
-  {
-    if (q->c != c)
-      continue;
-    if (queue_is_sendable (q))
-    {
-      LOG (GNUNET_ERROR_TYPE_DEBUG, "  sendable!!\n");
-      return q;
-    }
-    LOG (GNUNET_ERROR_TYPE_DEBUG, "  not sendable\n");
-  }
-
-  return NULL;
-}
-
-
 /**
  * Get the first message for a connection and unqueue it.
  *
@@ -1613,55 +2098,82 @@ GCP_connection_pop (struct CadetPeer *peer,
                     struct CadetConnection *c,
                     int *destroyed)
 {
+  struct CadetPeerConnectionQueue *cq;
   struct CadetPeerQueue *q;
   struct CadetPeerQueue *next;
   struct GNUNET_MessageHeader *msg;
+  struct GNUNET_HashCode key;
+  unsigned int qc;
   int dest;
+  int fwd;
 
   GCC_check_connections ();
   GNUNET_assert (NULL != destroyed);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "connection_pop on connection %p\n", c);
-  for (q = peer->queue_head; NULL != q; q = next)
+  if (GNUNET_YES == *destroyed)
+    return NULL; /* Destroying c cancelled everything queued on it */
+  key = *GCC_get_h (c);
+  for (qc = 0; qc < CADET_PEER_QUEUE_DATA_FWD; qc++)
+  {
+    for (q = peer->queue_head[qc]; NULL != q; q = next)
+    {
+      next = q->next;
+      if (q->c != c)
+        continue;
+      LOG (GNUNET_ERROR_TYPE_DEBUG, " - queued: %s (%s %u), cont: %p\n",
+           GC_m2s (q->type), GC_m2s (q->payload_type), q->payload_id,
+           q->cont);
+      switch (q->type)
+      {
+        case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_CREATE:
+        case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_ACK:
+        case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_DESTROY:
+        case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_BROKEN:
+        case GNUNET_MESSAGE_TYPE_CADET_ACK:
+        case GNUNET_MESSAGE_TYPE_CADET_POLL:
+          dest = GCP_queue_destroy (q, GNUNET_YES, GNUNET_NO, 0);
+          if (GNUNET_YES == dest)
+          {
+            GNUNET_break (GNUNET_NO == *destroyed);
+            *destroyed = GNUNET_YES;
+          }
+          continue;
+
+        case GNUNET_MESSAGE_TYPE_CADET_KX:
+        case GNUNET_MESSAGE_TYPE_CADET_AX_KX:
+          msg = (struct GNUNET_MessageHeader *) q->cls;
+          dest = GCP_queue_destroy (q, GNUNET_NO, GNUNET_NO, 0);
+          if (GNUNET_YES == dest)
+          {
+            GNUNET_break (GNUNET_NO == *destroyed);
+            *destroyed = GNUNET_YES;
+          }
+          return msg;
+
+        default:
+          GNUNET_break (0);
+          LOG (GNUNET_ERROR_TYPE_DEBUG, "Unknown message %s\n",
+               GC_m2s (q->type));
+      }
+    }
+  }
+  if (GNUNET_YES == *destroyed)
+    return NULL;
+
+  for (fwd = GNUNET_NO; fwd <= GNUNET_YES; fwd++)
   {
-    next = q->next;
-    if (q->c != c)
+    cq = conn_queue_find (peer, &key, c, fwd);
+    if (NULL == cq)
       continue;
+    q = cq->head;
     LOG (GNUNET_ERROR_TYPE_DEBUG, " - queued: %s (%s %u), cont: %p\n",
          GC_m2s (q->type), GC_m2s (q->payload_type), q->payload_id,
          q->cont);
-    switch (q->type)
-    {
-      case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_CREATE:
-      case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_ACK:
-      case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_DESTROY:
-      case GNUNET_MESSAGE_TYPE_CADET_CONNECTION_BROKEN:
-      case GNUNET_MESSAGE_TYPE_CADET_ACK:
-      case GNUNET_MESSAGE_TYPE_CADET_POLL:
-        dest = GCP_queue_destroy (q, GNUNET_YES, GNUNET_NO, 0);
-        if (GNUNET_YES == dest)
-        {
-          GNUNET_break (GNUNET_NO == *destroyed);
-          *destroyed = GNUNET_YES;
-        }
-        continue;
-
-      case GNUNET_MESSAGE_TYPE_CADET_KX:
-      case GNUNET_MESSAGE_TYPE_CADET_ENCRYPTED:
-      case GNUNET_MESSAGE_TYPE_CADET_AX:
-      case GNUNET_MESSAGE_TYPE_CADET_AX_KX:
-        msg = (struct GNUNET_MessageHeader *) q->cls;
-        dest = GCP_queue_destroy (q, GNUNET_NO, GNUNET_NO, 0);
-        if (GNUNET_YES == dest)
-        {
-          GNUNET_break (GNUNET_NO == *destroyed);
-          *destroyed = GNUNET_YES;
-        }
-        return msg;
-
-      default:
-        GNUNET_break (0);
-        LOG (GNUNET_ERROR_TYPE_DEBUG, "Unknown message %s\n", GC_m2s (q->type));
-    }
+    msg = (struct GNUNET_MessageHeader *) q->cls;
+    dest = GCP_queue_destroy (q, GNUNET_NO, GNUNET_NO, 0);
+    if (GNUNET_YES == dest)
+      *destroyed = GNUNET_YES;
+    return msg;
   }
   GCC_check_connections ();
   return NULL;
@@ -1671,7 +2183,8 @@ GCP_connection_pop (struct CadetPeer *peer,
 /**
  * Unlock a possibly locked queue for a connection.
  *
- * If there is a message that can be sent on this connection, call core for it.
+ * Make the connection's payload queues ready if flow control allows it and,
+ * if there is a message that can be sent, call core for it.
  * Otherwise (if core transmit is already called or there is no sendable
  * message) do nothing.
  *
@@ -1681,30 +2194,39 @@ GCP_connection_pop (struct CadetPeer *peer,
 void
 GCP_queue_unlock (struct CadetPeer *peer, struct CadetConnection *c)
 {
+  struct CadetPeerConnectionQueue *cq;
   struct CadetPeerQueue *q;
-  size_t size;
+  struct GNUNET_HashCode key;
+  int fwd;
 
   GCC_check_connections ();
+  key = *GCC_get_h (c);
+  for (fwd = GNUNET_NO; fwd <= GNUNET_YES; fwd++)
+  {
+    cq = conn_queue_find (peer, &key, c, fwd);
+    if (NULL != cq && GNUNET_NO == cq->ready)
+      conn_queue_set_ready (cq, GCC_is_sendable (c, fwd));
+  }
+
   if (NULL != peer->core_transmit)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  already unlocked!\n");
     return; /* Already unlocked */
   }
 
-  q = connection_get_first_message (peer, c);
+  q = peer_get_first_message (peer);
   if (NULL == q)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "  queue empty!\n");
     return; /* Nothing to transmit */
   }
 
-  size = q->size;
   peer->core_transmit =
       GNUNET_CORE_notify_transmit_ready (core_handle,
                                          GNUNET_NO, get_priority (q),
                                          GNUNET_TIME_UNIT_FOREVER_REL,
                                          GNUNET_PEER_resolve2 (peer->id),
-                                         get_core_size (size),
+                                         get_core_request_size (peer, q),
                                          &queue_send,
                                          peer);
   peer->tmt_time = GNUNET_TIME_absolute_get ();
@@ -188,6 +188,58 @@ struct CadetTunnelSkippedKey
    * Message key.
    */
   struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+
+  /**
+   * Key number for a given HK.
+   */
+  uint32_t Kn;
+};
+
+
+/**
+ * Payload of an Axolotl message that is being decrypted in the
+ * crypto offload pool.  Kept in a per-tunnel DLL in the order the
+ * messages were received, so that they are delivered in order.
+ */
+struct CadetTunnelDecryptJob
+{
+  /**
+   * DLL next.
+   */
+  struct CadetTunnelDecryptJob *next;
+
+  /**
+   * DLL prev.
+   */
+  struct CadetTunnelDecryptJob *prev;
+
+  /**
+   * Tunnel the message was received on.
+   */
+  struct CadetTunnel *t;
+
+  /**
+   * Job in the crypto offload pool, NULL once done.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Message key to decrypt the payload with.
+   */
+  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+
+  /**
+   * Size of the payload.
+   */
+  size_t size;
+
+  /**
+   * Size of the decrypted payload, -1 on error.  Only valid once
+   * @e job is NULL.
+   */
+  int result;
+
+  /* followed by the payload, decrypted in place */
 };
 
 
@@ -213,6 +265,12 @@ struct CadetTunnelAxolotl
    */
   unsigned int skipped;
 
+  /**
+   * The skipped keys, indexed by the hash of their HK and Kn
+   * (see #get_skipped_key_id()).
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *skipped_map;
+
   /**
    * 32-byte root key which gets updated by DH ratchet.
    */
@@ -354,6 +412,16 @@ struct CadetTunnel
    */
   struct GNUNET_CRYPTO_SymmetricSessionKey d_key;
 
+  /**
+   * Cipher context for encryption, rekeyed to whichever key is in use.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *e_ctx;
+
+  /**
+   * Cipher context for decryption, rekeyed to whichever key is in use.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *d_ctx;
+
   /**
    * Task to start the rekey process.
    */
@@ -406,6 +474,17 @@ struct CadetTunnel
    * Pong message in the queue.
    */
   struct CadetConnectionQueue *pong_h;
+
+  /**
+   * Messages whose payload is being decrypted in the crypto
+   * offload pool, in the order they were received (head).
+   */
+  struct CadetTunnelDecryptJob *dj_head;
+
+  /**
+   * Messages being decrypted, tail.
+   */
+  struct CadetTunnelDecryptJob *dj_tail;
 };
 
 
@@ -519,6 +598,12 @@ static unsigned long long ratchet_messages;
  */
 static struct GNUNET_TIME_Relative ratchet_time;
 
+/**
+ * Do we decrypt the payload of Axolotl messages in the
+ * crypto offload pool?
+ */
+static int crypto_offload;
+
 
 /********************************    OTR   ***********************************/
 
@@ -944,7 +1029,12 @@ t_encrypt (struct CadetTunnel *t, void *dst, const void *src,
   #endif
   GNUNET_CRYPTO_symmetric_derive_iv (&siv, key, &iv, sizeof (iv), NULL);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  t_encrypt IV derived\n");
-  out_size = GNUNET_CRYPTO_symmetric_encrypt (src, size, key, &siv, dst);
+  if (NULL == t->e_ctx)
+    t->e_ctx = GNUNET_CRYPTO_symmetric_context_create (key);
+  else
+    GNUNET_CRYPTO_symmetric_context_set_key (t->e_ctx, key);
+  out_size = GNUNET_CRYPTO_symmetric_context_encrypt (t->e_ctx, src, size,
+                                                      &siv, dst);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  t_encrypt end\n");
 
   return out_size;
@@ -1076,9 +1166,10 @@ t_ax_encrypt (struct CadetTunnel *t, void *dst, const void *src, size_t size)
 
 
 /**
- * Decrypt data with the axolotl tunnel key.
+ * Decrypt data with an axolotl message key.  Does not touch any
+ * tunnel state, so it can be called from the crypto offload pool.
  *
- * @param t Tunnel whose key to use.
+ * @param MK Message key to use.
  * @param dst Destination for the decrypted data.
  * @param src Source of the ciphertext. Can overlap with @c dst.
  * @param size Size of the ciphertext.
@@ -1086,36 +1177,13 @@ t_ax_encrypt (struct CadetTunnel *t, void *dst, const void *src, size_t size)
  * @return Size of the decrypted data.
  */
 static int
-t_ax_decrypt (struct CadetTunnel *t, void *dst, const void *src, size_t size)
+t_ax_decrypt (const struct GNUNET_CRYPTO_SymmetricSessionKey *MK,
+              void *dst, const void *src, size_t size)
 {
-  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
-  struct CadetTunnelAxolotl *ax;
-  size_t out_size;
-
-  LOG (GNUNET_ERROR_TYPE_DEBUG, "  t_ax_decrypt start\n");
 
-  ax = t->ax;
-
-  t_hmac_derive_key (&ax->CKr, &MK, "0", 1);
-  GNUNET_CRYPTO_symmetric_derive_iv (&iv, &MK, NULL, 0, NULL);
-
-  #if DUMP_KEYS_TO_STDERR
-  LOG (GNUNET_ERROR_TYPE_INFO, "  CKr: %s\n",
-       GNUNET_i2s ((struct GNUNET_PeerIdentity *) &ax->CKr));
-  LOG (GNUNET_ERROR_TYPE_INFO, "  AX_DEC with key %u: %s\n", ax->Nr,
-       GNUNET_i2s ((struct GNUNET_PeerIdentity *) &MK));
-  #endif
-
-  GNUNET_assert (size >= sizeof (struct GNUNET_MessageHeader));
-  out_size = GNUNET_CRYPTO_symmetric_decrypt (src, size, &MK, &iv, dst);
-  GNUNET_assert (out_size == size);
-
-  t_hmac_derive_key (&ax->CKr, &ax->CKr, "1", 1);
-
-  LOG (GNUNET_ERROR_TYPE_DEBUG, "  t_ax_decrypt end\n");
-
-  return out_size;
+  GNUNET_CRYPTO_symmetric_derive_iv (&iv, MK, NULL, 0, NULL);
+  return GNUNET_CRYPTO_symmetric_decrypt (src, size, MK, &iv, dst);
 }
 
 
@@ -1188,6 +1256,7 @@ t_h_decrypt (struct CadetTunnel *t, const struct GNUNET_CADET_AX *src,
 /**
  * Decrypt and verify data with the appropriate tunnel key.
  *
+ * @param t Tunnel whose cipher context to use.
  * @param key Key to use.
  * @param dst Destination for the plaintext.
  * @param src Source of the encrypted data. Can overlap with @c dst.
@@ -1197,7 +1266,8 @@ t_h_decrypt (struct CadetTunnel *t, const struct GNUNET_CADET_AX *src,
  * @return Size of the decrypted data, -1 if an error was encountered.
  */
 static int
-decrypt (const struct GNUNET_CRYPTO_SymmetricSessionKey *key,
+decrypt (struct CadetTunnel *t,
+         const struct GNUNET_CRYPTO_SymmetricSessionKey *key,
          void *dst, const void *src, size_t size, uint32_t iv)
 {
   struct GNUNET_CRYPTO_SymmetricInitializationVector siv;
@@ -1207,7 +1277,12 @@ decrypt (const struct GNUNET_CRYPTO_SymmetricSessionKey *key,
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  decrypt iv\n");
   GNUNET_CRYPTO_symmetric_derive_iv (&siv, key, &iv, sizeof (iv), NULL);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  decrypt iv done\n");
-  out_size = GNUNET_CRYPTO_symmetric_decrypt (src, size, key, &siv, dst);
+  if (NULL == t->d_ctx)
+    t->d_ctx = GNUNET_CRYPTO_symmetric_context_create (key);
+  else
+    GNUNET_CRYPTO_symmetric_context_set_key (t->d_ctx, key);
+  out_size = GNUNET_CRYPTO_symmetric_context_decrypt (t->d_ctx, src, size,
+                                                      &siv, dst);
   LOG (GNUNET_ERROR_TYPE_DEBUG, "  decrypt end\n");
 
   return out_size;
@@ -1245,7 +1320,7 @@ t_decrypt (struct CadetTunnel *t, void *dst, const void *src,
     return -1;
   }
 
-  out_size = decrypt (&t->d_key, dst, src, size, iv);
+  out_size = decrypt (t, &t->d_key, dst, src, size, iv);
 
   return out_size;
 }
@@ -1276,7 +1351,7 @@ t_decrypt_and_validate (struct CadetTunnel *t,
 
   /* Try primary (newest) key */
   key = &t->d_key;
-  decrypted_size = decrypt (key, dst, src, size, iv);
+  decrypted_size = decrypt (t, key, dst, src, size, iv);
   t_hmac (src, size, iv, key, &hmac);
   if (0 == memcmp (msg_hmac, &hmac, sizeof (hmac)))
     return decrypted_size;
@@ -1293,14 +1368,14 @@ t_decrypt_and_validate (struct CadetTunnel *t,
 
   /* Try secondary key, from previous KX period. */
   key = &t->kx_ctx->d_key_old;
-  decrypted_size = decrypt (key, dst, src, size, iv);
+  decrypted_size = decrypt (t, key, dst, src, size, iv);
   t_hmac (src, size, iv, key, &hmac);
   if (0 == memcmp (msg_hmac, &hmac, sizeof (hmac)))
     return decrypted_size;
 
   /* Hail Mary, try tertiary, key, in case of parallel re-keys. */
   key = &t->kx_ctx->d_key_old2;
-  decrypted_size = decrypt (key, dst, src, size, iv);
+  decrypted_size = decrypt (t, key, dst, src, size, iv);
   t_hmac (src, size, iv, key, &hmac);
   if (0 == memcmp (msg_hmac, &hmac, sizeof (hmac)))
     return decrypted_size;
@@ -1314,58 +1389,149 @@ t_decrypt_and_validate (struct CadetTunnel *t,
 
 
 /**
- * Decrypt and verify data with the appropriate tunnel key and verify that the
- * data has not been altered since it was sent by the remote peer.
+ * Compute the index of a skipped key in the skipped key map.
+ *
+ * @param HK Header key of the skipped key.
+ * @param Kn Key number of the skipped key.
+ * @param id[out] Where to store the index.
+ */
+static void
+get_skipped_key_id (const struct GNUNET_CRYPTO_SymmetricSessionKey *HK,
+                    uint32_t Kn,
+                    struct GNUNET_HashCode *id)
+{
+  struct
+  {
+    struct GNUNET_CRYPTO_SymmetricSessionKey HK;
+    uint32_t Kn;
+  } GNUNET_PACKED buf;
+
+  buf.HK = *HK;
+  buf.Kn = htonl (Kn);
+  GNUNET_CRYPTO_hash (&buf, sizeof (buf), id);
+}
+
+
+/**
+ * Delete a key from the list of skipped keys.
+ *
+ * @param t Tunnel to delete from.
+ * @param key Key to delete.
+ */
+static void
+delete_skipped_key (struct CadetTunnel *t, struct CadetTunnelSkippedKey *key)
+{
+  struct GNUNET_HashCode id;
+
+  get_skipped_key_id (&key->HK, key->Kn, &id);
+  GNUNET_break (GNUNET_YES ==
+                GNUNET_CONTAINER_multihashmap_remove (t->ax->skipped_map,
+                                                      &id, key));
+  GNUNET_CONTAINER_DLL_remove (t->ax->skipped_head, t->ax->skipped_tail, key);
+  GNUNET_free (key);
+  t->ax->skipped--;
+}
+
+
+/**
+ * Take a skipped key out of the store to decrypt a message with it.
+ *
+ * @param t Tunnel whose skipped keys to use.
+ * @param HK Header key the message was sent with.
+ * @param Np Message number of the message.
+ * @param MK[out] Where to store the message key.
+ *
+ * @return #GNUNET_OK if the key was found, #GNUNET_NO if not
+ *         (i.e. the message is a replay or too old).
+ */
+static int
+use_skipped_key (struct CadetTunnel *t,
+                 const struct GNUNET_CRYPTO_SymmetricSessionKey *HK,
+                 uint32_t Np,
+                 struct GNUNET_CRYPTO_SymmetricSessionKey *MK)
+{
+  struct CadetTunnelSkippedKey *key;
+  struct GNUNET_HashCode id;
+
+  if (NULL == t->ax->skipped_map)
+    return GNUNET_NO;
+  get_skipped_key_id (HK, Np, &id);
+  key = GNUNET_CONTAINER_multihashmap_get (t->ax->skipped_map, &id);
+  if (NULL == key)
+  {
+    GNUNET_STATISTICS_update (stats, "# AX skipped key not found",
+                              1, GNUNET_NO);
+    return GNUNET_NO;
+  }
+  #if DUMP_KEYS_TO_STDERR
+  LOG (GNUNET_ERROR_TYPE_INFO, "  AX_DEC with skipped key %s\n",
+       GNUNET_i2s ((struct GNUNET_PeerIdentity *) &key->MK));
+  #endif
+  *MK = key->MK;
+  delete_skipped_key (t, key);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Find the message key for a message sent with the header key of a
+ * previous ratchet, using the stored skipped keys.
+ *
+ * Each distinct header key in the store is tried once (the keys of
+ * one ratchet are adjacent in the list), the message key is then
+ * looked up by header key and message number.
  *
  * @param t Tunnel whose key to use.
- * @param dst Destination for the plaintext.
- * @param src Source of the message. Can overlap with @c dst.
+ * @param dst Scratch space for the decrypted header.
+ * @param src Source of the message.
  * @param size Size of the message.
+ * @param MK[out] Where to store the message key.
  *
- * @return Size of the decrypted data, -1 if an error was encountered.
+ * @return Size of the payload, -1 if an error was encountered.
  */
 static int
 try_old_ax_keys (struct CadetTunnel *t, struct GNUNET_CADET_AX *dst,
-                 const struct GNUNET_CADET_AX *src, size_t size)
+                 const struct GNUNET_CADET_AX *src, size_t size,
+                 struct GNUNET_CRYPTO_SymmetricSessionKey *MK)
 {
   struct CadetTunnelSkippedKey *key;
+  struct CadetTunnelSkippedKey *tried;
   struct GNUNET_CADET_Hash hmac;
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
-  size_t res;
-  size_t len;
-
+  struct GNUNET_CRYPTO_SymmetricSessionKey HK;
+  size_t esize;
 
+  GNUNET_assert (size > sizeof (struct GNUNET_CADET_AX));
+  esize = size - sizeof (struct GNUNET_CADET_AX);
+  tried = NULL;
   for (key = t->ax->skipped_head; NULL != key; key = key->next)
   {
-    t_hmac (&src->Ns, AX_HEADER_SIZE, 0, &key->HK, &hmac);
-    if (0 != memcmp (&hmac, &src->hmac, sizeof (hmac)))
+    if ( (NULL != tried) &&
+         (0 == memcmp (&tried->HK, &key->HK, sizeof (key->HK))) )
+      continue;
+    tried = key;
+    t_hmac (&src->Ns, AX_HEADER_SIZE + esize, 0, &key->HK, &hmac);
+    if (0 == memcmp (&hmac, &src->hmac, sizeof (hmac)))
       break;
   }
   if (NULL == key)
     return -1;
 
-  #if DUMP_KEYS_TO_STDERR
-  LOG (GNUNET_ERROR_TYPE_INFO, "  AX_DEC with skipped key %s\n",
-       GNUNET_i2s ((struct GNUNET_PeerIdentity *) &key->MK));
-  #endif
-
-  GNUNET_assert (size > sizeof (struct GNUNET_CADET_AX));
-  len = size - sizeof (struct GNUNET_CADET_AX);
-  GNUNET_CRYPTO_symmetric_derive_iv (&iv, &key->MK, NULL, 0, NULL);
-  res = GNUNET_CRYPTO_symmetric_decrypt (&src[1], len, &key->MK, &iv, &dst[1]);
-
-  GNUNET_CONTAINER_DLL_remove (t->ax->skipped_head, t->ax->skipped_tail, key);
-  t->ax->skipped--;
-  GNUNET_free (key);
-
-  return res;
+  HK = key->HK;
+  GNUNET_CRYPTO_symmetric_derive_iv (&iv, &HK, NULL, 0, NULL);
+  GNUNET_assert (AX_HEADER_SIZE ==
+                 GNUNET_CRYPTO_symmetric_decrypt (&src->Ns, AX_HEADER_SIZE,
+                                                  &HK, &iv, &dst->Ns));
+  if (GNUNET_OK != use_skipped_key (t, &HK, ntohl (dst->Ns), MK))
+    return -1;
+  return esize;
 }
 
 
 /**
- * Delete a key from the list of skipped keys.
+ * Stage skipped AX keys and calculate the message key.
  *
- * @param t Tunnel to delete from.
+ * @param t Tunnel where to stage the keys.
  * @param HKr Header Key to use.
  */
 static void
@@ -1373,10 +1539,12 @@ store_skipped_key (struct CadetTunnel *t,
                    const struct GNUNET_CRYPTO_SymmetricSessionKey *HKr)
 {
   struct CadetTunnelSkippedKey *key;
+  struct GNUNET_HashCode id;
 
   key = GNUNET_new (struct CadetTunnelSkippedKey);
   key->timestamp = GNUNET_TIME_absolute_get ();
-  key->HK = t->ax->HKr;
+  key->Kn = t->ax->Nr;
+  key->HK = *HKr;
   t_hmac_derive_key (&t->ax->CKr, &key->MK, "0", 1);
   #if DUMP_KEYS_TO_STDERR
   LOG (GNUNET_ERROR_TYPE_INFO, "    storing MK for Nr %u: %s\n",
@@ -1385,27 +1553,20 @@ store_skipped_key (struct CadetTunnel *t,
        GNUNET_i2s ((struct GNUNET_PeerIdentity *) &t->ax->CKr));
   #endif
   t_hmac_derive_key (&t->ax->CKr, &t->ax->CKr, "1", 1);
+  if (NULL == t->ax->skipped_map)
+    t->ax->skipped_map
+      = GNUNET_CONTAINER_multihashmap_create (MAX_SKIPPED_KEYS, GNUNET_NO);
+  get_skipped_key_id (&key->HK, key->Kn, &id);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (t->ax->skipped_map,
+                                                    &id, key,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
   GNUNET_CONTAINER_DLL_insert (t->ax->skipped_head, t->ax->skipped_tail, key);
   t->ax->Nr++;
   t->ax->skipped++;
 }
 
 
-/**
- * Delete a key from the list of skipped keys.
- *
- * @param t Tunnel to delete from.
- * @param key Key to delete.
- */
-static void
-delete_skipped_key (struct CadetTunnel *t, struct CadetTunnelSkippedKey *key)
-{
-  GNUNET_CONTAINER_DLL_remove (t->ax->skipped_head, t->ax->skipped_tail, key);
-  GNUNET_free (key);
-  t->ax->skipped--;
-}
-
-
 /**
  * Stage skipped AX keys and calculate the message key.
  *
@@ -1442,19 +1603,22 @@ store_ax_keys (struct CadetTunnel *t,
 
 
 /**
- * Decrypt and verify data with the appropriate tunnel key and verify that the
- * data has not been altered since it was sent by the remote peer.
+ * Verify that an Axolotl message has not been altered since it was sent
+ * by the remote peer, advance the ratchet and compute the key for the
+ * message's payload.
  *
  * @param t Tunnel whose key to use.
- * @param dst Destination for the plaintext.
+ * @param dst Scratch space for the decrypted header (at least @a size bytes).
  * @param src Source of the message. Can overlap with @c dst.
  * @param size Size of the message.
+ * @param MK[out] Where to store the message key for the payload.
  *
- * @return Size of the decrypted data, -1 if an error was encountered.
+ * @return Size of the payload, -1 if an error was encountered.
  */
 static int
-t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
-                           const struct GNUNET_CADET_AX *src, size_t size)
+t_ax_get_message_key (struct CadetTunnel *t, void *dst,
+                      const struct GNUNET_CADET_AX *src, size_t size,
+                      struct GNUNET_CRYPTO_SymmetricSessionKey *MK)
 {
   struct CadetTunnelAxolotl *ax;
   struct GNUNET_CADET_Hash msg_hmac;
@@ -1463,7 +1627,6 @@ t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
   uint32_t Np;
   uint32_t PNp;
   size_t esize;
-  size_t osize;
 
   ax = t->ax;
   dstmsg = dst;
@@ -1487,7 +1650,7 @@ t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
     if (0 != memcmp (&msg_hmac, &src->hmac, sizeof (msg_hmac)))
     {
       /* Try the skipped keys, if that fails, we're out of luck. */
-      return try_old_ax_keys (t, dst, src, size);
+      return try_old_ax_keys (t, dst, src, size, MK);
     }
     LOG (GNUNET_ERROR_TYPE_INFO, "next HK\n");
 
@@ -1519,6 +1682,13 @@ t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
     t_h_decrypt (t, src, dstmsg);
     Np = ntohl (dstmsg->Ns);
     PNp = ntohl (dstmsg->PNs);
+    if (Np < ax->Nr)
+    {
+      /* Reordered message of the current ratchet */
+      if (GNUNET_OK != use_skipped_key (t, &ax->HKr, Np, MK))
+        return -1;
+      return esize;
+    }
   }
 
   if (Np > ax->Nr)
@@ -1526,7 +1696,42 @@ t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
 
   ax->Nr = Np + 1;
 
-  osize = t_ax_decrypt (t, dst, &src[1], esize);
+  t_hmac_derive_key (&ax->CKr, MK, "0", 1);
+  #if DUMP_KEYS_TO_STDERR
+  LOG (GNUNET_ERROR_TYPE_INFO, "  CKr: %s\n",
+       GNUNET_i2s ((struct GNUNET_PeerIdentity *) &ax->CKr));
+  LOG (GNUNET_ERROR_TYPE_INFO, "  AX_DEC with key %u: %s\n", Np,
+       GNUNET_i2s ((struct GNUNET_PeerIdentity *) MK));
+  #endif
+  t_hmac_derive_key (&ax->CKr, &ax->CKr, "1", 1);
+
+  return esize;
+}
+
+
+/**
+ * Decrypt and verify data with the appropriate tunnel key and verify that the
+ * data has not been altered since it was sent by the remote peer.
+ *
+ * @param t Tunnel whose key to use.
+ * @param dst Destination for the plaintext.
+ * @param src Source of the message. Can overlap with @c dst.
+ * @param size Size of the message.
+ *
+ * @return Size of the decrypted data, -1 if an error was encountered.
+ */
+static int
+t_ax_decrypt_and_validate (struct CadetTunnel *t, void *dst,
+                           const struct GNUNET_CADET_AX *src, size_t size)
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+  int esize;
+  size_t osize;
+
+  esize = t_ax_get_message_key (t, dst, src, size, &MK);
+  if (-1 == esize)
+    return -1;
+  osize = t_ax_decrypt (&MK, dst, &src[1], esize);
   if (osize != esize)
   {
     GNUNET_break_op (0);
@@ -1751,6 +1956,95 @@ tunnel_get_connection (struct CadetTunnel *t)
 }
 
 
+/**
+ * Get the connection to send the next striped message of a multipath
+ * channel on.
+ *
+ * Every ready connection with buffer space is scored by the round trip
+ * time of its path times the number of messages already queued on it,
+ * so that messages are spread over all paths in proportion to their
+ * speed.  Connections whose RTT is not known yet get the mean RTT of
+ * the others.
+ *
+ * @param t Tunnel on which to send the message.
+ *
+ * @return Connection to use, NULL if none is ready.
+ */
+static struct CadetConnection *
+tunnel_get_striped_connection (struct CadetTunnel *t)
+{
+  struct CadetTConnection *iter;
+  struct CadetConnection *best;
+  uint64_t rtt_sum;
+  uint64_t rtt;
+  uint64_t score;
+  uint64_t lowest_score;
+  unsigned int rtt_n;
+  int fwd;
+
+  rtt_sum = 0;
+  rtt_n = 0;
+  for (iter = t->connection_head; NULL != iter; iter = iter->next)
+  {
+    rtt = GCC_get_rtt (iter->c).rel_value_us;
+    if (0 != rtt)
+    {
+      rtt_sum += rtt;
+      rtt_n++;
+    }
+  }
+
+  best = NULL;
+  lowest_score = UINT64_MAX;
+  for (iter = t->connection_head; NULL != iter; iter = iter->next)
+  {
+    if (CADET_CONNECTION_READY != GCC_get_state (iter->c))
+      continue;
+    fwd = GCC_is_origin (iter->c, GNUNET_YES);
+    if (0 == GCC_get_buffer (iter->c, fwd))
+      continue;
+    rtt = GCC_get_rtt (iter->c).rel_value_us;
+    if (0 == rtt)
+      rtt = (0 == rtt_n) ? 1 : rtt_sum / rtt_n;
+    score = rtt * (GCC_get_qn (iter->c, fwd) + 1);
+    if (score < lowest_score)
+    {
+      best = iter->c;
+      lowest_score = score;
+    }
+  }
+  if (NULL == best)
+    return tunnel_get_connection (t);
+  LOG (GNUNET_ERROR_TYPE_DEBUG, " striped: connection %s\n", GCC_2s (best));
+  return best;
+}
+
+
+/**
+ * Is a message data of a multipath channel, to be striped over all
+ * connections of the tunnel?
+ *
+ * @param t Tunnel the message is sent on.
+ * @param message Message to send.
+ *
+ * @return #GNUNET_YES if the message should be striped.
+ */
+static int
+is_striped (struct CadetTunnel *t, const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_CADET_Data *dmsg;
+  struct CadetChannel *ch;
+
+  if (GNUNET_MESSAGE_TYPE_CADET_DATA != ntohs (message->type))
+    return GNUNET_NO;
+  dmsg = (const struct GNUNET_CADET_Data *) message;
+  ch = GCT_get_channel (t, ntohl (dmsg->chid));
+  if (NULL == ch)
+    return GNUNET_NO;
+  return GCCH_is_multipath (ch);
+}
+
+
 /**
  * Callback called when a queued message is sent.
  *
@@ -1920,7 +2214,12 @@ send_prebuilt_message (const struct GNUNET_MessageHeader *message,
   GNUNET_assert (esize == size);
 
   if (NULL == c)
-    c = tunnel_get_connection (t);
+  {
+    if (GNUNET_YES == is_striped (t, message))
+      c = tunnel_get_striped_connection (t);
+    else
+      c = tunnel_get_connection (t);
+  }
   if (NULL == c)
   {
     /* Why is tunnel 'ready'? Should have been queued! */
@@ -2534,11 +2833,19 @@ handle_data_ack (struct CadetTunnel *t,
 
   /* Check size */
   size = ntohs (msg->header.size);
-  if (size != sizeof (struct GNUNET_CADET_DataACK))
+  if (size < sizeof (struct GNUNET_CADET_DataACK))
   {
     GNUNET_break (0);
     return;
   }
+  size -= sizeof (struct GNUNET_CADET_DataACK);
+  if ( (0 != size % sizeof (struct GNUNET_CADET_DataACKRange)) ||
+       (GNUNET_CADET_MAX_ACK_RANGES <
+        size / sizeof (struct GNUNET_CADET_DataACKRange)) )
+  {
+    GNUNET_break_op (0);
+    return;
+  }
 
   /* Check channel */
   ch = GCT_get_channel (t, ntohl (msg->chid));
@@ -2646,7 +2953,8 @@ handle_ch_ack (struct CadetTunnel *t,
 
   /* Check size */
   size = ntohs (msg->header.size);
-  if (size != sizeof (struct GNUNET_CADET_ChannelManage))
+  if ( (size != sizeof (struct GNUNET_CADET_ChannelManage)) &&
+       (size != sizeof (struct GNUNET_CADET_ChannelAck)) )
   {
     GNUNET_break (0);
     return;
@@ -2721,6 +3029,11 @@ destroy_ax (struct CadetTunnel *t)
   while (NULL != t->ax->skipped_head)
     delete_skipped_key (t, t->ax->skipped_head);
   GNUNET_assert (0 == t->ax->skipped);
+  if (NULL != t->ax->skipped_map)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (t->ax->skipped_map);
+    t->ax->skipped_map = NULL;
+  }
 
   GNUNET_free (t->ax);
   t->ax = NULL;
@@ -3075,6 +3388,156 @@ handle_decrypted (struct CadetTunnel *t,
 }
 
 
+/**
+ * Check a decrypted payload and hand every message it contains to
+ * #handle_decrypted().
+ *
+ * @param t Tunnel the payload came on.
+ * @param buf Decrypted payload.
+ * @param size Size of @a buf, -1 if the payload could not be decrypted.
+ */
+static void
+handle_decrypted_payload (struct CadetTunnel *t, const char *buf, int size)
+{
+  const struct GNUNET_MessageHeader *msgh;
+  unsigned int off;
+
+  if (-1 == size)
+  {
+    GNUNET_break_op (0);
+    GNUNET_STATISTICS_update (stats, "# unable to decrypt", 1, GNUNET_NO);
+    LOG (GNUNET_ERROR_TYPE_WARNING, "Wrong crypto on tunnel %s\n", GCT_2s (t));
+    GCT_debug (t, GNUNET_ERROR_TYPE_WARNING);
+    return;
+  }
+  GCT_change_estate (t, CADET_TUNNEL_KEY_OK);
+
+  /* FIXME: this is bad, as the structs returned from
+     this loop may be unaligned, see util's MST for
+     how to do this right. */
+  off = 0;
+  while (off + sizeof (struct GNUNET_MessageHeader) < size)
+  {
+    uint16_t msize;
+
+    msgh = (const struct GNUNET_MessageHeader *) &buf[off];
+    msize = ntohs (msgh->size);
+    if (msize < sizeof (struct GNUNET_MessageHeader))
+    {
+      GNUNET_break_op (0);
+      return;
+    }
+    if (off + msize < size)
+    {
+      GNUNET_break_op (0);
+      return;
+    }
+    handle_decrypted (t, msgh, GNUNET_SYSERR);
+    off += msize;
+  }
+}
+
+
+/**
+ * Decrypt the payload of a message in the crypto offload pool.
+ * Runs in a worker thread.
+ *
+ * @param cls Closure (CadetTunnelDecryptJob).
+ *
+ * @return Size of the decrypted payload, -1 on error.
+ */
+static int
+decrypt_job_run (void *cls)
+{
+  struct CadetTunnelDecryptJob *dj = cls;
+  int osize;
+
+  osize = t_ax_decrypt (&dj->MK, &dj[1], &dj[1], dj->size);
+  if (osize != (int) dj->size)
+    return -1;
+  return osize;
+}
+
+
+/**
+ * A payload was decrypted in the crypto offload pool.  Deliver all
+ * payloads of the tunnel that are done, in the order they were received.
+ *
+ * @param cls Closure (CadetTunnelDecryptJob).
+ * @param result Size of the decrypted payload, -1 on error.
+ */
+static void
+decrypt_job_done (void *cls, int result)
+{
+  struct CadetTunnelDecryptJob *dj = cls;
+  struct CadetTunnel *t = dj->t;
+
+  dj->job = NULL;
+  dj->result = result;
+  while ( (NULL != (dj = t->dj_head)) &&
+          (NULL == dj->job) )
+  {
+    GNUNET_CONTAINER_DLL_remove (t->dj_head, t->dj_tail, dj);
+    GNUNET_STATISTICS_update (stats, "# AX payloads in crypto pool",
+                              -1, GNUNET_NO);
+    handle_decrypted_payload (t, (const char *) &dj[1], dj->result);
+    GNUNET_free (dj);
+  }
+}
+
+
+/**
+ * Queue the payload of a message for decryption in the crypto offload
+ * pool.  The ratchet was already advanced on the main thread, so only
+ * the symmetric decryption of the payload is left.
+ *
+ * @param t Tunnel the message came on.
+ * @param MK Message key for the payload.
+ * @param payload Encrypted payload.
+ * @param size Size of @a payload.
+ */
+static void
+queue_decrypt_job (struct CadetTunnel *t,
+                   const struct GNUNET_CRYPTO_SymmetricSessionKey *MK,
+                   const void *payload, size_t size)
+{
+  struct CadetTunnelDecryptJob *dj;
+
+  dj = GNUNET_malloc (sizeof (struct CadetTunnelDecryptJob) + size);
+  dj->t = t;
+  dj->MK = *MK;
+  dj->size = size;
+  memcpy (&dj[1], payload, size);
+  GNUNET_CONTAINER_DLL_insert_tail (t->dj_head, t->dj_tail, dj);
+  GNUNET_STATISTICS_update (stats, "# AX payloads in crypto pool",
+                            1, GNUNET_NO);
+  dj->job = GNUNET_CRYPTO_offload (&decrypt_job_run, dj,
+                                   &decrypt_job_done, dj);
+}
+
+
+/**
+ * Cancel all payload decryptions of a tunnel.
+ *
+ * @param t Tunnel.
+ */
+static void
+cancel_decrypt_jobs (struct CadetTunnel *t)
+{
+  struct CadetTunnelDecryptJob *dj;
+
+  while (NULL != (dj = t->dj_head))
+  {
+    if (NULL != dj->job)
+      GNUNET_CRYPTO_offload_cancel (dj->job);
+    GNUNET_CONTAINER_DLL_remove (t->dj_head, t->dj_tail, dj);
+    GNUNET_STATISTICS_update (stats, "# AX payloads in crypto pool",
+                              -1, GNUNET_NO);
+    GNUNET_free (dj);
+  }
+}
+
+
 /******************************************************************************/
 /********************************    API    ***********************************/
 /******************************************************************************/
@@ -3093,8 +3556,6 @@ GCT_handle_encrypted (struct CadetTunnel *t,
   char cbuf [size];
   int decrypted_size;
   uint16_t type;
-  const struct GNUNET_MessageHeader *msgh;
-  unsigned int off;
 
   type = ntohs (msg->type);
   switch (type)
@@ -3117,7 +3578,21 @@ GCT_handle_encrypted (struct CadetTunnel *t,
 
       GNUNET_STATISTICS_update (stats, "# received Axolotl", 1, GNUNET_NO);
       emsg = (const struct GNUNET_CADET_AX *) msg;
-      decrypted_size = t_ax_decrypt_and_validate (t, cbuf, emsg, size);
+      if (GNUNET_YES == crypto_offload)
+      {
+        struct GNUNET_CRYPTO_SymmetricSessionKey MK;
+
+        decrypted_size = t_ax_get_message_key (t, cbuf, emsg, size, &MK);
+        if (-1 != decrypted_size)
+        {
+          queue_decrypt_job (t, &MK, &emsg[1], decrypted_size);
+          return;
+        }
+      }
+      else
+      {
+        decrypted_size = t_ax_decrypt_and_validate (t, cbuf, emsg, size);
+      }
     }
     break;
   default:
@@ -3125,39 +3600,7 @@ GCT_handle_encrypted (struct CadetTunnel *t,
     return;
   }
 
-  if (-1 == decrypted_size)
-  {
-    GNUNET_break_op (0);
-    GNUNET_STATISTICS_update (stats, "# unable to decrypt", 1, GNUNET_NO);
-    LOG (GNUNET_ERROR_TYPE_WARNING, "Wrong crypto on tunnel %s\n", GCT_2s (t));
-    GCT_debug (t, GNUNET_ERROR_TYPE_WARNING);
-    return;
-  }
-  GCT_change_estate (t, CADET_TUNNEL_KEY_OK);
-
-  /* FIXME: this is bad, as the structs returned from
-     this loop may be unaligned, see util's MST for
-     how to do this right. */
-  off = 0;
-  while (off + sizeof (struct GNUNET_MessageHeader) < decrypted_size)
-  {
-    uint16_t msize;
-
-    msgh = (const struct GNUNET_MessageHeader *) &cbuf[off];
-    msize = ntohs (msgh->size);
-    if (msize < sizeof (struct GNUNET_MessageHeader))
-    {
-      GNUNET_break_op (0);
-      return;
-    }
-    if (off + msize < decrypted_size)
-    {
-      GNUNET_break_op (0);
-      return;
-    }
-    handle_decrypted (t, msgh, GNUNET_SYSERR);
-    off += msize;
-  }
+  handle_decrypted_payload (t, cbuf, decrypted_size);
 }
 
 
@@ -3248,6 +3691,10 @@ GCT_init (const struct GNUNET_CONFIGURATION_Handle *c,
                                "CADET", "RATCHET_TIME", "USING DEFAULT");
     ratchet_time = GNUNET_TIME_UNIT_HOURS;
   }
+  crypto_offload = GNUNET_CONFIGURATION_get_value_yesno (c, "CADET",
+                                                         "OFFLOAD_CRYPTO");
+  if (GNUNET_SYSERR == crypto_offload)
+    crypto_offload = GNUNET_NO;
 
 
   id_key = key;
@@ -3807,8 +4254,13 @@ GCT_destroy (struct CadetTunnel *t)
     GNUNET_free (t->kx_ctx);
   }
 
+  cancel_decrypt_jobs (t);
   if (NULL != t->ax)
     destroy_ax (t);
+  if (NULL != t->e_ctx)
+    GNUNET_CRYPTO_symmetric_context_destroy (t->e_ctx);
+  if (NULL != t->d_ctx)
+    GNUNET_CRYPTO_symmetric_context_destroy (t->d_ctx);
 
   GNUNET_free (t);
 }
@@ -1,15 +1,21 @@
 #!/bin/sh
 
-if [ "$#" -lt "3" ]; then
+if [ "$1" = "-b" ]; then
+    if [ "$#" -lt "8" ]; then
+        echo "usage: $0 -b DURATION PEERS TUNNELS CHANNELS SIZE bulk|rr OPTIONS [DO_WARMUP]";
+        echo "example: $0 -b 30s 16 4 2 1024 bulk R";
+        exit 1;
+    fi
+    PEERS=$3
+elif [ "$#" -lt "3" ]; then
     echo "usage: $0 ROUND_TIME PEERS PINGING_PEERS";
+    echo "       $0 -b DURATION PEERS TUNNELS CHANNELS SIZE bulk|rr OPTIONS [DO_WARMUP]";
     echo "example: $0 30s 16 1";
     exit 1;
+else
+    PEERS=$2
 fi
 
-ROUNDTIME=$1
-PEERS=$2
-PINGS=$3
-
 if [ $PEERS -eq 1 ]; then
     echo "cannot run 1 peer";
     exit 1;
@@ -22,4 +28,4 @@ echo "using $PEERS peers, $LINKS links";
     
 sed -e "s/%LINKS%/$LINKS/;s/%NSE%/$NSE/" profiler.conf > .profiler.conf
 
-./gnunet-cadet-profiler $ROUNDTIME $PEERS $PINGS $4 |& tee log | grep -v DEBUG
+./gnunet-cadet-profiler "$@" |& tee log | grep -v DEBUG
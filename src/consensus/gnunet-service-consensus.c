@@ -221,6 +221,13 @@ struct ConsensusSession
    * Uses the session's global id as app id.
    */
   struct GNUNET_SET_ListenHandle *set_listener;
+
+  /**
+   * #GNUNET_YES if requests of peers that are already in a later
+   * subround are served immediately instead of being delayed until
+   * we reach that subround ourselves.
+   */
+  int pipeline;
 };
 
 
@@ -259,6 +266,23 @@ struct ConsensusPeerInformation
    * Info about the round of the delayed set operation.
    */
   struct RoundInfo delayed_round_info;
+
+  /**
+   * Info about the round of @e set_op.
+   */
+  struct RoundInfo set_op_round_info;
+
+  /**
+   * #GNUNET_YES if a set operation for a later subround
+   * (see @e early_round_info) has already finished, which
+   * only happens in pipelined sessions.
+   */
+  int early_finished;
+
+  /**
+   * Info about the round of the operation that finished early.
+   */
+  struct RoundInfo early_round_info;
 };
 
 
@@ -316,6 +340,22 @@ have_exp_subround_finished (const struct ConsensusSession *session)
 }
 
 
+/**
+ * Get the round the session is currently in.
+ *
+ * @param session the session
+ * @param[out] ri where to store the round info
+ */
+static void
+get_round_info (const struct ConsensusSession *session,
+                struct RoundInfo *ri)
+{
+  ri->round = session->current_round;
+  ri->exp_repetition = session->exp_repetition;
+  ri->exp_subround = session->exp_subround;
+}
+
+
 /**
  * Destroy a session, free all resources associated with it.
  *
@@ -597,6 +637,39 @@ find_partners (struct ConsensusSession *session)
 }
 
 
+/**
+ * Compare the round the session is in with the round of the given context message.
+ *
+ * @param session a consensus session
+ * @param ri a round context message
+ * @return 0 if it's the same round, -1 if the session is in an earlier round,
+ *         1 if the session is in a later round
+ */
+static int
+rounds_compare (struct ConsensusSession *session,
+                struct RoundInfo* ri)
+{
+  if (session->current_round < ri->round)
+    return -1;
+  if (session->current_round > ri->round)
+    return 1;
+  if (session->current_round == CONSENSUS_ROUND_EXCHANGE)
+  {
+    if (session->exp_repetition < ri->exp_repetition)
+      return -1;
+    if (session->exp_repetition > ri->exp_repetition)
+      return 1;
+    if (session->exp_subround < ri->exp_subround)
+      return -1;
+    if (session->exp_subround > ri->exp_subround)
+      return 1;
+    return 0;
+  }
+  /* other rounds have no subrounds / repetitions to compare */
+  return 0;
+}
+
+
 /**
  * Callback for set operation results. Called for each element
  * in the result set.
@@ -617,6 +690,32 @@ set_result_cb (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: set result from P%u with status %u\n",
               local_idx, remote_idx, (unsigned int) status);
 
+  if ( (GNUNET_YES == cpi->session->pipeline) &&
+       (rounds_compare (cpi->session, &cpi->set_op_round_info) < 0) )
+  {
+    /* operation for a subround we have not reached yet */
+    switch (status)
+    {
+      case GNUNET_SET_STATUS_OK:
+        GNUNET_SET_add_element (cpi->session->element_set, element, NULL, NULL);
+        return;
+      case GNUNET_SET_STATUS_FAILURE:
+        cpi->set_op = NULL;
+        return;
+      case GNUNET_SET_STATUS_HALF_DONE:
+      case GNUNET_SET_STATUS_DONE:
+        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: early set operation with P%u done\n",
+                    local_idx, remote_idx);
+        cpi->set_op = NULL;
+        cpi->early_finished = GNUNET_YES;
+        cpi->early_round_info = cpi->set_op_round_info;
+        return;
+      default:
+        GNUNET_break (0);
+        return;
+    }
+  }
+
   GNUNET_assert ((cpi == cpi->session->partner_outgoing) ||
                  (cpi == cpi->session->partner_incoming));
 
@@ -667,39 +766,6 @@ set_result_cb (void *cls,
 }
 
 
-/**
- * Compare the round the session is in with the round of the given context message.
- *
- * @param session a consensus session
- * @param ri a round context message
- * @return 0 if it's the same round, -1 if the session is in an earlier round,
- *         1 if the session is in a later round
- */
-static int
-rounds_compare (struct ConsensusSession *session,
-                struct RoundInfo* ri)
-{
-  if (session->current_round < ri->round)
-    return -1;
-  if (session->current_round > ri->round)
-    return 1;
-  if (session->current_round == CONSENSUS_ROUND_EXCHANGE)
-  {
-    if (session->exp_repetition < ri->exp_repetition)
-      return -1;
-    if (session->exp_repetition > ri->exp_repetition)
-      return 1;
-    if (session->exp_subround < ri->exp_subround)
-      return -1;
-    if (session->exp_subround > ri->exp_subround)
-      return 1;
-    return 0;
-  }
-  /* other rounds have no subrounds / repetitions to compare */
-  return 0;
-}
-
-
 /**
  * Do the next subround in the exp-scheme.
  * This function can be invoked as a timeout task, or called manually (tc will be NULL then).
@@ -739,7 +805,9 @@ subround_over (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
   for (i = 0; i < session->num_peers; i++)
   {
-    if (NULL != session->info[i].set_op)
+    if ( (NULL != session->info[i].set_op) &&
+         ( (GNUNET_NO == session->pipeline) ||
+           (rounds_compare (session, &session->info[i].set_op_round_info) >= 0) ) )
     {
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%d: canceling stray op with P%d\n",
                   session->local_peer_idx, i);
@@ -810,6 +878,7 @@ subround_over (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
       GNUNET_break (0);
       GNUNET_SET_operation_cancel (session->partner_outgoing->set_op);
     }
+    get_round_info (session, &session->partner_outgoing->set_op_round_info);
     session->partner_outgoing->set_op =
         GNUNET_SET_prepare (&session->partner_outgoing->peer_id,
                             &session->global_id,
@@ -843,6 +912,7 @@ subround_over (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
         GNUNET_break (0);
       }
       session->partner_incoming->set_op = session->partner_incoming->delayed_set_op;
+      session->partner_incoming->set_op_round_info = session->partner_incoming->delayed_round_info;
       session->partner_incoming->delayed_set_op = NULL;
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%d resumed delayed round with P%d\n",
                   session->local_peer_idx, (int) (session->partner_incoming - session->info));
@@ -854,6 +924,26 @@ subround_over (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     }
   }
 
+  /* the incoming partner may already have been served while we were
+   * still busy with an earlier subround */
+  for (i = 0; i < session->num_peers; i++)
+  {
+    struct ConsensusPeerInformation *cpi = &session->info[i];
+
+    if (GNUNET_NO == cpi->early_finished)
+      continue;
+    if (rounds_compare (session, &cpi->early_round_info) < 0)
+      continue;
+    cpi->early_finished = GNUNET_NO;
+    if ( (cpi == session->partner_incoming) &&
+         (0 == rounds_compare (session, &cpi->early_round_info)) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%d: early round with P%d already done\n",
+                  session->local_peer_idx, i);
+      cpi->set_op_finished = GNUNET_YES;
+    }
+  }
+
 #ifdef GNUNET_EXTRA_LOGGING
   {
     int in;
@@ -871,6 +961,9 @@ subround_over (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   }
 #endif /* GNUNET_EXTRA_LOGGING */
 
+  /* nothing left to wait for if the subround was done in advance */
+  if (GNUNET_YES == have_exp_subround_finished (session))
+    subround_over (session, NULL);
 }
 
 
@@ -1082,12 +1175,27 @@ set_listen_cb (void *cls,
           return;
         }
         cpi->set_op = set_op;
+        cpi->set_op_round_info = round_info;
         if (GNUNET_OK != GNUNET_SET_commit (set_op, session->element_set))
         {
           GNUNET_break (0);
         }
         GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%d commited to set request from P%d\n", session->local_peer_idx, index);
       }
+      else if ( (GNUNET_YES == session->pipeline) &&
+                (CONSENSUS_ROUND_EXCHANGE == session->current_round) )
+      {
+        /* serve the other peer with what we have right now, instead of
+         * stalling it until we have caught up */
+        cpi->set_op = set_op;
+        cpi->set_op_round_info = round_info;
+        cpi->early_finished = GNUNET_NO;
+        if (GNUNET_OK != GNUNET_SET_commit (set_op, session->element_set))
+        {
+          GNUNET_break (0);
+        }
+        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%d commited early to set request from P%d\n", session->local_peer_idx, index);
+      }
       else
       {
         /* we still have wait until we have finished the current round,
@@ -1152,6 +1260,11 @@ initialize_session (struct ConsensusSession *session,
 
   session->local_peer_idx = get_peer_idx (&my_peer, session);
   GNUNET_assert (-1 != session->local_peer_idx);
+  session->pipeline = GNUNET_CONFIGURATION_get_value_yesno (cfg,
+                                                            "consensus",
+                                                            "PIPELINE");
+  if (GNUNET_SYSERR == session->pipeline)
+    session->pipeline = GNUNET_NO;
   session->element_set = GNUNET_SET_create (cfg, GNUNET_SET_OPERATION_UNION);
   GNUNET_assert (NULL != session->element_set);
   session->set_listener = GNUNET_SET_listen (cfg, GNUNET_SET_OPERATION_UNION,
@@ -52,6 +52,28 @@
 /* 120ms at 48000 */
 #define MAX_FRAME_SIZE (960 * 6)
 
+/**
+ * Smallest playback delay (in ms) the jitter buffer aims for.
+ */
+#define MIN_DELAY_MS 40
+
+/**
+ * Largest playback delay (in ms) the jitter buffer grows to,
+ * unless given on the command line.
+ */
+#define MAX_DELAY_MS 400
+
+/**
+ * How much (in ms) to grow the playback delay after an underrun.
+ */
+#define UNDERRUN_DELAY_MS 20
+
+/**
+ * Do not conceal gaps longer than this many samples (1s),
+ * just continue playing from the next packet.
+ */
+#define MAX_CONCEAL_SAMPLES SAMPLING_RATE
+
 /**
  * Pulseaudio specification. May change in the future.
  */
@@ -121,6 +143,52 @@ static int preskip;
 
 static float gain;
 
+/**
+ * Upper limit for the playback delay in ms.
+ */
+static unsigned int max_delay_ms = MAX_DELAY_MS;
+
+/**
+ * Playback delay in ms currently requested from PulseAudio.
+ */
+static unsigned int delay_ms;
+
+/**
+ * Extra delay in ms added after underruns, decays over time.
+ */
+static unsigned int underrun_delay_ms;
+
+/**
+ * Number of underruns reported by PulseAudio.
+ * Written by the PulseAudio thread.
+ */
+static volatile unsigned int underruns;
+
+/**
+ * Number of underruns already accounted for in @a underrun_delay_ms.
+ */
+static unsigned int underruns_seen;
+
+/**
+ * Interarrival jitter estimate in microseconds (see RFC 3550).
+ */
+static int64_t jitter_us;
+
+/**
+ * Arrival time of the last audio page.
+ */
+static struct GNUNET_TIME_Absolute last_arrival;
+
+/**
+ * Granule position of the last audio page.
+ */
+static int64_t last_page_granule;
+
+/**
+ * Granule position up to which we decoded (or concealed) audio.
+ */
+static int64_t dec_granule;
+
 GNUNET_NETWORK_STRUCT_BEGIN
 
 /* OggOpus spec says the numbers must be in little-endian order */
@@ -330,6 +398,159 @@ audio_write (int64_t maxout)
 }
 
 
+/**
+ * Apply header gain, if we're not using an opus library new
+ * enough to do this internally.
+ */
+static void
+apply_gain ()
+{
+  int i;
+
+  if (0 == gain)
+    return;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Applying gain %f\n",
+              gain);
+  for (i = 0; i < frame_size * channels; i++)
+    pcm_buffer[i] *= gain;
+}
+
+
+/**
+ * Ask PulseAudio to keep @a ms of audio buffered for playback.
+ *
+ * Playback (re)starts only once that much audio is buffered,
+ * which makes the PulseAudio buffer our jitter buffer.
+ *
+ * @param ms playback delay in ms
+ */
+static void
+playback_delay_set (unsigned int ms)
+{
+  pa_buffer_attr attr;
+  pa_operation *o;
+
+  delay_ms = ms;
+  if (NULL == stream_out)
+    return;
+  attr.maxlength = (uint32_t) -1;
+  attr.tlength = pa_usec_to_bytes ((pa_usec_t) ms * 1000, &sample_spec);
+  attr.prebuf = (uint32_t) -1;
+  attr.minreq = (uint32_t) -1;
+  attr.fragsize = (uint32_t) -1;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Setting playback delay to %u ms\n",
+              ms);
+  pa_threaded_mainloop_lock (m);
+  o = pa_stream_set_buffer_attr (stream_out, &attr, NULL, NULL);
+  if (NULL != o)
+    pa_operation_unref (o);
+  pa_threaded_mainloop_unlock (m);
+}
+
+
+/**
+ * An audio page arrived.  Update the jitter estimate and adapt
+ * the playback delay to it.
+ *
+ * The delay covers three times the interarrival jitter, plus some
+ * extra delay after underruns, which slowly decays again.
+ *
+ * @param page_granule granule position of the page
+ */
+static void
+jitter_update (int64_t page_granule)
+{
+  struct GNUNET_TIME_Absolute now = GNUNET_TIME_absolute_get ();
+  unsigned int target_ms;
+
+  if (0 != last_arrival.abs_value_us
+      && page_granule > last_page_granule)
+  {
+    int64_t d = (int64_t) (now.abs_value_us - last_arrival.abs_value_us)
+      - (page_granule - last_page_granule) * 1000LL * 1000LL / 48000;
+    if (0 > d)
+      d = -d;
+    jitter_us += (d - jitter_us) / 16;
+  }
+  last_arrival = now;
+  last_page_granule = page_granule;
+
+  if (underruns_seen != underruns)
+  {
+    underrun_delay_ms += (underruns - underruns_seen) * UNDERRUN_DELAY_MS;
+    underruns_seen = underruns;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Playback underrun, adding %u ms of delay\n",
+                underrun_delay_ms);
+  }
+  else if (0 < underrun_delay_ms)
+  {
+    underrun_delay_ms--;
+  }
+
+  target_ms = MIN_DELAY_MS + 3 * jitter_us / 1000 + underrun_delay_ms;
+  if (target_ms > max_delay_ms)
+    target_ms = max_delay_ms;
+  if (underrun_delay_ms > max_delay_ms)
+    underrun_delay_ms = max_delay_ms;
+  /* Avoid changing the buffer for every packet */
+  if (target_ms >= delay_ms + 10 || target_ms + 10 <= delay_ms)
+    playback_delay_set (target_ms);
+}
+
+
+/**
+ * Audio before packet @a op was lost.  Play @a lost samples in its
+ * place: the frame right before @a op is recovered from the forward
+ * error correction data in @a op, frames before that are generated
+ * by the packet loss concealment of the decoder.
+ *
+ * @param op packet received after the gap
+ * @param lost number of samples lost
+ * @param nb number of samples in a frame
+ * @return number of samples written
+ */
+static int64_t
+conceal_loss (ogg_packet *op, int64_t lost, int nb)
+{
+  int64_t sampout = 0;
+  int fec_samples = (lost >= nb) ? nb : 0;
+  int ret;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Concealing %" PRId64 " lost samples\n",
+              lost);
+  lost -= fec_samples;
+  while (0 < lost)
+  {
+    int plc_samples = (lost > nb) ? nb : (int) lost;
+    ret = opus_decode_float (dec, NULL, 0, pcm_buffer, plc_samples, 0);
+    if (0 > ret)
+      return sampout;
+    frame_size = ret;
+    apply_gain ();
+    sampout += audio_write (ret);
+    lost -= plc_samples;
+  }
+  if (0 < fec_samples)
+  {
+    ret = opus_decode_float (dec,
+                             (const unsigned char *) op->packet,
+                             op->bytes,
+                             pcm_buffer,
+                             fec_samples, 1);
+    if (0 > ret)
+      return sampout;
+    frame_size = ret;
+    apply_gain ();
+    sampout += audio_write (ret);
+  }
+  return sampout;
+}
+
+
 /**
  * Pulseaudio shutdown task
  */
@@ -348,6 +569,7 @@ ogg_demux_and_decode ()
   static int stream_init;
   int64_t page_granule = 0;
   ogg_packet op;
+  int pret;
   static int has_opus_stream;
   static int has_tags_packet;
   static int32_t opus_serialno;
@@ -380,8 +602,17 @@ ogg_demux_and_decode ()
                 "Reading page that ends at %" PRId64 "\n",
                 page_granule);
     /*Extract all available packets*/
-    while (1 == ogg_stream_packetout (&os, &op))
+    while (0 != (pret = ogg_stream_packetout (&os, &op)))
     {
+      if (-1 == pret)
+      {
+        /*Hole in the data: pages were lost, we conceal them below
+          based on the granule positions.*/
+        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                    "Lost page(s) before page %ld\n",
+                    ogg_page_pageno (&og));
+        continue;
+      }
       /*OggOpus streams are identified by a magic string in the initial
         stream header.*/
       if (op.b_o_s && op.bytes >= 8 && !memcmp (op.packet, "OpusHead", 8))
@@ -452,6 +683,7 @@ ogg_demux_and_decode ()
         /*Remember how many samples at the front we were told to skip
           so that we can adjust the timestamp counting.*/
         gran_offset = preskip;
+        dec_granule = 0;
 
         if (!pcm_buffer)
         {
@@ -474,6 +706,7 @@ ogg_demux_and_decode ()
       else
       {
         int ret;
+        int nb;
         int64_t maxout;
         int64_t outsamp;
 
@@ -485,6 +718,28 @@ ogg_demux_and_decode ()
           eos = 1; /* don't care for anything except opus eos */
         }
 
+        /*Detect lost packets: the granule position of the last packet on
+          a page tells where its audio ends.*/
+        nb = opus_packet_get_nb_samples ((const unsigned char *) op.packet,
+                                         op.bytes, SAMPLING_RATE);
+        if (0 < nb && -1 != op.granulepos)
+        {
+          int64_t lost = op.granulepos - nb - dec_granule;
+
+          jitter_update (op.granulepos);
+          if (0 < lost && lost <= MAX_CONCEAL_SAMPLES)
+            link_out += conceal_loss (&op, lost, nb);
+          else if (0 < lost)
+            GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                        "Not concealing gap of %" PRId64 " samples\n",
+                        lost);
+          dec_granule = op.granulepos;
+        }
+        else if (0 < nb)
+        {
+          dec_granule += nb;
+        }
+
         /*Decode Opus packet*/
         ret = opus_decode_float (dec,
 			         (const unsigned char *) op.packet,
@@ -503,17 +758,7 @@ ogg_demux_and_decode ()
                     "Decoded %d bytes/channel (%d bytes) from %u compressed bytes\n",
                     ret, ret * channels, op.bytes);
 
-        /*Apply header gain, if we're not using an opus library new
-          enough to do this internally.*/
-        if (0 != gain)
-        {
-          int i;
-          GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                      "Applying gain %f\n",
-                      gain);
-          for (i = 0; i < frame_size * channels; i++)
-            pcm_buffer[i] *= gain;
-        }
+        apply_gain ();
 
         /*This handles making sure that our output duration respects
           the final end-trim by not letting the output sample count
@@ -589,6 +834,17 @@ stream_write_callback (pa_stream *s,
 }
 
 
+/**
+ * Callback when the playback buffer ran empty
+ */
+static void
+stream_underflow_callback (pa_stream *s,
+                           void *userdata)
+{
+  underruns++;
+}
+
+
 /**
  * Exit callback for SIGTERM and SIGINT
  */
@@ -622,6 +878,8 @@ context_state_callback (pa_context *c,
     break;
   case PA_CONTEXT_READY:
   {
+    pa_buffer_attr attr;
+
     GNUNET_assert (! stream_out);
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
 		_("Connection established.\n"));
@@ -636,9 +894,20 @@ context_state_callback (pa_context *c,
     pa_stream_set_write_callback (stream_out,
 				  &stream_write_callback,
 				  NULL);
+    pa_stream_set_underflow_callback (stream_out,
+                                      &stream_underflow_callback,
+                                      NULL);
+    /* Start with the smallest delay, the jitter buffer grows as needed */
+    delay_ms = MIN_DELAY_MS;
+    attr.maxlength = (uint32_t) -1;
+    attr.tlength = pa_usec_to_bytes ((pa_usec_t) delay_ms * 1000,
+                                     &sample_spec);
+    attr.prebuf = (uint32_t) -1;
+    attr.minreq = (uint32_t) -1;
+    attr.fragsize = (uint32_t) -1;
     if ((p =
 	 pa_stream_connect_playback (stream_out, NULL,
-				     NULL,
+				     &attr,
 				     PA_STREAM_ADJUST_LATENCY | PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE,
 				     NULL,  NULL)) < 0)
     {
@@ -730,6 +999,8 @@ drain_callback (pa_stream*s, int success, void *userdata)
 /**
  * The main function for the playback helper.
  *
+ * Usage: gnunet-helper-audio-playback [MAX_DELAY_MS]
+ *
  * @param argc number of arguments from the command line
  * @param argv command line arguments
  * @return 0 ok, 1 on error
@@ -751,6 +1022,8 @@ main (int argc, char *argv[])
 		 GNUNET_log_setup ("gnunet-helper-audio-playback",
 				   "WARNING",
 				   NULL));
+  if (argc > 1)
+    max_delay_ms = GNUNET_MAX (MIN_DELAY_MS, strtoul (argv[1], NULL, 10));
   if (0 != pipe (ready_pipe))
   {
     GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "pipe");
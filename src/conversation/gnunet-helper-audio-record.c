@@ -48,17 +48,13 @@
 #define SAMPLING_RATE 48000
 
 /**
- * How many ms of audio to buffer before encoding them.
+ * How many ms of audio to buffer before encoding them, unless
+ * given on the command line.
  * Possible values:
- * 60, 40, 20, 10, 5, 2.5
+ * 60, 40, 20, 10, 5
  */
 #define FRAME_SIZE_MS 40
 
-/**
- * How many samples to buffer before encoding them.
- */
-#define FRAME_SIZE (SAMPLING_RATE / 1000 * FRAME_SIZE_MS)
-
 /**
  * Pages are commited when their size goes over this value.
  * Note that in practice we flush pages VERY often (every frame),
@@ -81,7 +77,8 @@
 #define CHANNELS 1
 
 /**
- * Configures the encoder's expected packet loss percentage.
+ * Configures the encoder's expected packet loss percentage,
+ * unless given on the command line.
  *
  * Higher values will trigger progressively more loss resistant behavior
  * in the encoder at the expense of quality at a given bitrate
@@ -220,6 +217,17 @@ static float *pcm_buffer;
  */
 static int pcm_length;
 
+/**
+ * How many samples to buffer before encoding them.
+ */
+static int frame_size;
+
+/**
+ * Expected packet loss percentage the encoder adds
+ * forward error correction for.
+ */
+static int packet_loss_percentage;
+
 /**
  * Audio buffer
  */
@@ -335,7 +343,7 @@ packetizer ()
 	    pcm_length);
     transmit_buffer_index += pcm_length;
     len =
-      opus_encode_float (enc, pcm_buffer, FRAME_SIZE, opus_data,
+      opus_encode_float (enc, pcm_buffer, frame_size, opus_data,
 			 MAX_PAYLOAD_BYTES);
 
     if (len < 0)
@@ -353,7 +361,7 @@ packetizer ()
 
     /* As per OggOpus spec, granule is calculated as if the audio
        had 48kHz sampling rate. */
-    enc_granulepos += FRAME_SIZE * 48000 / SAMPLING_RATE;
+    enc_granulepos += frame_size * 48000 / SAMPLING_RATE;
 
     op.packet = (unsigned char *) opus_data;
     op.bytes = len;
@@ -642,7 +650,7 @@ opus_init ()
 {
   int err;
 
-  pcm_length = FRAME_SIZE * CHANNELS * sizeof (float);
+  pcm_length = frame_size * CHANNELS * sizeof (float);
   pcm_buffer = pa_xmalloc (pcm_length);
   opus_data = GNUNET_malloc (MAX_PAYLOAD_BYTES);
   enc = opus_encoder_create (SAMPLING_RATE,
@@ -650,7 +658,7 @@ opus_init ()
 			     CONV_OPUS_APP_TYPE,
 			     &err);
   opus_encoder_ctl (enc,
-		    OPUS_SET_PACKET_LOSS_PERC (CONV_OPUS_PACKET_LOSS_PERCENTAGE));
+		    OPUS_SET_PACKET_LOSS_PERC (packet_loss_percentage));
   opus_encoder_ctl (enc,
 		    OPUS_SET_COMPLEXITY (CONV_OPUS_ENCODING_COMPLEXITY));
   opus_encoder_ctl (enc,
@@ -750,6 +758,8 @@ ogg_init ()
 /**
  * The main function for the record helper.
  *
+ * Usage: gnunet-helper-audio-record [FRAME_SIZE_MS [PACKET_LOSS_PERCENTAGE]]
+ *
  * @param argc number of arguments from the command line
  * @param argv command line arguments
  * @return 0 ok, 1 on error
@@ -757,10 +767,34 @@ ogg_init ()
 int
 main (int argc, char *argv[])
 {
+  unsigned int frame_size_ms = FRAME_SIZE_MS;
+
   GNUNET_assert (GNUNET_OK ==
 		 GNUNET_log_setup ("gnunet-helper-audio-record",
 				   "WARNING",
 				   NULL));
+  packet_loss_percentage = CONV_OPUS_PACKET_LOSS_PERCENTAGE;
+  if (argc > 1)
+  {
+    frame_size_ms = strtoul (argv[1], NULL, 10);
+    switch (frame_size_ms)
+    {
+    case 5:
+    case 10:
+    case 20:
+    case 40:
+    case 60:
+      break;
+    default:
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Unsupported frame size of %u ms, using %u ms\n"),
+                  frame_size_ms, FRAME_SIZE_MS);
+      frame_size_ms = FRAME_SIZE_MS;
+    }
+  }
+  if (argc > 2)
+    packet_loss_percentage = GNUNET_MIN (100, strtoul (argv[2], NULL, 10));
+  frame_size = SAMPLING_RATE / 1000 * frame_size_ms;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Audio source starts\n");
   audio_message = GNUNET_malloc (UINT16_MAX);
@@ -102,12 +102,32 @@ enable (void *cls,
 	void *rdc_cls)
 {
   struct Microphone *mic = cls;
-  static char * const record_helper_argv[] =
+  unsigned long long frame_size_ms;
+  unsigned long long packet_loss;
+  char frame_size_str[16];
+  char packet_loss_str[16];
+  char * const record_helper_argv[] =
   {
     "gnunet-helper-audio-record",
+    frame_size_str,
+    packet_loss_str,
     NULL
   };
 
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (mic->cfg, "conversation",
+                                             "AUDIO_FRAME_MS",
+                                             &frame_size_ms))
+    frame_size_ms = 40;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (mic->cfg, "conversation",
+                                             "AUDIO_EXPECTED_LOSS",
+                                             &packet_loss))
+    packet_loss = 5;
+  GNUNET_snprintf (frame_size_str, sizeof (frame_size_str),
+                   "%llu", frame_size_ms);
+  GNUNET_snprintf (packet_loss_str, sizeof (packet_loss_str),
+                   "%llu", packet_loss);
   mic->rdc = rdc;
   mic->rdc_cls = rdc_cls;
   mic->record_helper = GNUNET_HELPER_start (GNUNET_NO,
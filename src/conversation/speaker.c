@@ -58,12 +58,24 @@ static int
 enable (void *cls)
 {
   struct Speaker *spe = cls;
-  static char *playback_helper_argv[] =
+  struct GNUNET_TIME_Relative max_delay;
+  char max_delay_str[16];
+  char *playback_helper_argv[] =
   {
     "gnunet-helper-audio-playback",
+    max_delay_str,
     NULL
   };
 
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (spe->cfg, "conversation",
+                                           "JITTER_BUFFER_MAX",
+                                           &max_delay))
+    max_delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                               400);
+  GNUNET_snprintf (max_delay_str, sizeof (max_delay_str),
+                   "%llu", (unsigned long long) max_delay.rel_value_us / 1000LL);
+
   spe->playback_helper = GNUNET_HELPER_start (GNUNET_NO,
 					      "gnunet-helper-audio-playback",
 					      playback_helper_argv,
@@ -76,6 +76,12 @@ struct GSC_ClientActiveRequest
    */
   enum GNUNET_CORE_Priority priority;
 
+  /**
+   * Node in the request heap of the session for @e priority
+   * while the request waits for solicitation, NULL otherwise.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
   /**
    * Has this request been solicited yet?
    */
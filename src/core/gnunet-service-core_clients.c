@@ -212,19 +212,22 @@ type_match (uint16_t type, struct GSC_Client *c)
  *
  * @param partner origin (or destination) of the message (used to check that this peer is
  *        known to be connected to the respective client)
- * @param msg message to multicast
+ * @param sm message to multicast, queued to all clients without copying
  * @param can_drop can this message be discarded if the queue is too long
  * @param options mask to use
  * @param type type of the embedded message, 0 for none
  */
 static void
 send_to_all_clients (const struct GNUNET_PeerIdentity *partner,
-                     const struct GNUNET_MessageHeader *msg, int can_drop,
+                     struct GNUNET_SERVER_SharedMessage *sm, int can_drop,
                      uint32_t options, uint16_t type)
 {
+  const struct GNUNET_MessageHeader *msg;
   struct GSC_Client *c;
   int tm;
 
+  msg = GNUNET_SERVER_shared_message_get (sm);
+
   for (c = client_head; NULL != c; c = c->next)
   {
     tm = type_match (type, c);
@@ -249,7 +252,10 @@ send_to_all_clients (const struct GNUNET_PeerIdentity *partner,
 		    (GNUNET_YES ==
 		     GNUNET_CONTAINER_multipeermap_contains (c->connectmap,
 							     partner)) );
-    send_to_client (c, msg, can_drop);
+    GNUNET_SERVER_notification_context_unicast_shared (notifier,
+                                                       c->client_handle,
+                                                       sm,
+                                                       can_drop);
   }
 }
 
@@ -810,7 +816,7 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
                              uint32_t options)
 {
   size_t size = msize + sizeof (struct NotifyTrafficMessage);
-  char buf[size] GNUNET_ALIGN;
+  struct GNUNET_SERVER_SharedMessage *sm;
   struct NotifyTrafficMessage *ntm;
 
   if (size >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
@@ -827,7 +833,9 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
               GNUNET_i2s (sender),
               (unsigned int) ntohs (msg->type));
   GSC_SESSIONS_add_to_typemap (sender, ntohs (msg->type));
-  ntm = (struct NotifyTrafficMessage *) buf;
+  /* build the notification once; all interested clients share it */
+  sm = GNUNET_SERVER_shared_message_create (size);
+  ntm = (struct NotifyTrafficMessage *) GNUNET_SERVER_shared_message_get (sm);
   ntm->header.size = htons (size);
   if (0 != (options & (GNUNET_CORE_OPTION_SEND_FULL_INBOUND | GNUNET_CORE_OPTION_SEND_HDR_INBOUND)))
     ntm->header.type = htons (GNUNET_MESSAGE_TYPE_CORE_NOTIFY_INBOUND);
@@ -838,10 +846,11 @@ GSC_CLIENTS_deliver_message (const struct GNUNET_PeerIdentity *sender,
           msg,
           msize);
   send_to_all_clients (sender,
-                       &ntm->header,
+                       sm,
                        GNUNET_YES,
                        options,
                        ntohs (msg->type));
+  GNUNET_SERVER_shared_message_drop (sm);
 }
 
 
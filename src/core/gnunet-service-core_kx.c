@@ -56,6 +56,12 @@
  */
 #define REKEY_TOLERANCE GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
 
+/**
+ * Over how much time do we spread rekeying the individual peers?
+ * Must be well below #REKEY_TOLERANCE.
+ */
+#define REKEY_STAGGER GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 2)
+
 /**
  * What is the maximum age of a message for us to consider processing
  * it?  Note that this looks at the timestamp used by the other peer,
@@ -65,6 +71,12 @@
  */
 #define MAX_MESSAGE_AGE GNUNET_TIME_UNIT_DAYS
 
+/**
+ * Capability flag in a PONG: the sender accepts
+ * #GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_AEAD_MESSAGE.
+ */
+#define KX_CAPABILITY_AEAD 1
+
 
 
 GNUNET_NETWORK_STRUCT_BEGIN
@@ -171,9 +183,11 @@ struct PongMessage
   uint32_t challenge GNUNET_PACKED;
 
   /**
-   * Reserved, always zero.
+   * Capabilities of the sender (#KX_CAPABILITY_AEAD), in network
+   * byte order.  Peers that predate this field send zero and do
+   * not check it.
    */
-  uint32_t reserved;
+  uint32_t flags GNUNET_PACKED;
 
   /**
    * Intended target of the PING, used primarily to check
@@ -234,6 +248,66 @@ GNUNET_NETWORK_STRUCT_END
  */
 #define ENCRYPTED_HEADER_SIZE (offsetof(struct EncryptedMessage, sequence_number))
 
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Encapsulation for messages encrypted and authenticated with
+ * AES-GCM in a single pass.  Followed by the actual encrypted
+ * data.  Only sent to peers that announced #KX_CAPABILITY_AEAD.
+ */
+struct EncryptedAeadMessage
+{
+  /**
+   * Message type is #GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_AEAD_MESSAGE.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Nonce, never reused under the same key.  Authenticated
+   * together with @e header.
+   */
+  unsigned char nonce[GNUNET_CRYPTO_AEAD_NONCE_LENGTH];
+
+  /**
+   * Authentication tag over the header, the nonce and the
+   * ciphertext.  #AEAD_HEADER_SIZE must be set to the offset of
+   * the *next* field.
+   */
+  unsigned char tag[GNUNET_CRYPTO_AEAD_TAG_LENGTH];
+
+  /**
+   * Sequence number, in network byte order.  This field
+   * must be the first encrypted/decrypted field
+   */
+  uint32_t sequence_number GNUNET_PACKED;
+
+  /**
+   * Reserved, always zero.
+   */
+  uint32_t reserved;
+
+  /**
+   * Timestamp.  Used to prevent replay of ancient messages
+   * (recent messages are caught with the sequence number).
+   */
+  struct GNUNET_TIME_AbsoluteNBO timestamp;
+
+};
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Number of bytes (at the beginning) of `struct EncryptedAeadMessage`
+ * that are NOT encrypted.
+ */
+#define AEAD_HEADER_SIZE (offsetof(struct EncryptedAeadMessage, sequence_number))
+
+/**
+ * Number of bytes (at the beginning) of `struct EncryptedAeadMessage`
+ * that are authenticated but NOT encrypted.
+ */
+#define AEAD_AAD_SIZE (offsetof(struct EncryptedAeadMessage, tag))
+
 
 /**
  * Information about the status of a key exchange with another peer.
@@ -278,6 +352,40 @@ struct GSC_KeyExchangeInfo
    */
   struct GNUNET_CRYPTO_SymmetricSessionKey decrypt_key;
 
+  /**
+   * Cipher context keyed with @e encrypt_key, NULL until first use.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *encrypt_ctx;
+
+  /**
+   * Cipher context keyed with @e decrypt_key, NULL until first use.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *decrypt_ctx;
+
+  /**
+   * AEAD context for messages to the other peer, NULL until
+   * the session keys have been derived.
+   */
+  struct GNUNET_CRYPTO_AeadContext *aead_encrypt_ctx;
+
+  /**
+   * AEAD context for messages from the other peer, NULL until
+   * the session keys have been derived.
+   */
+  struct GNUNET_CRYPTO_AeadContext *aead_decrypt_ctx;
+
+  /**
+   * Number of AEAD messages we encrypted so far; forms the
+   * lower 64 bits of the nonce and is never reset.
+   */
+  uint64_t aead_nonce_counter;
+
+  /**
+   * Random upper 32 bits of our AEAD nonces, chosen per
+   * key exchange.
+   */
+  uint32_t aead_nonce_prefix;
+
   /**
    * At what time did the other peer generate the decryption key?
    */
@@ -308,6 +416,22 @@ struct GSC_KeyExchangeInfo
    */
   struct GNUNET_SCHEDULER_Task *keep_alive_task;
 
+  /**
+   * Task for the staggered rekeying of this peer after we
+   * created a new ephemeral key, NULL if not pending.
+   */
+  struct GNUNET_SCHEDULER_Task *stagger_task;
+
+  /**
+   * EPHEMERAL_KEY message in the crypto pool, NULL for none.
+   */
+  struct EphemeralKeyJob *ekm_job;
+
+  /**
+   * ECDH for rekeying in the crypto pool, NULL for none.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *ecdh_job;
+
   /**
    * Bit map indicating which of the 32 sequence numbers before the last
    * were received (good for accepting out-of-order packets and
@@ -335,6 +459,12 @@ struct GSC_KeyExchangeInfo
    */
   enum GNUNET_CORE_KxState status;
 
+  /**
+   * #GNUNET_YES if the other peer announced #KX_CAPABILITY_AEAD
+   * in its last PONG, so we may send it AEAD messages.
+   */
+  int peer_aead;
+
 };
 
 
@@ -379,6 +509,11 @@ static struct GNUNET_SCHEDULER_Task *rekey_task;
  */
 static struct GNUNET_SERVER_NotificationContext *nc;
 
+/**
+ * Number of KX jobs currently in the crypto offload pool.
+ */
+static unsigned int kx_jobs_pending;
+
 
 /**
  * Inform the given monitor about the KX state of
@@ -542,6 +677,32 @@ derive_aes_key (const struct GNUNET_PeerIdentity *sender,
 }
 
 
+/**
+ * Derive an AEAD key from key material.  Uses a different context
+ * than #derive_aes_key(), so the AEAD and CFB keys are independent.
+ *
+ * @param sender peer identity of the sender
+ * @param receiver peer identity of the receiver
+ * @param key_material high entropy key material to use
+ * @param skey set to derived session key
+ */
+static void
+derive_aead_key (const struct GNUNET_PeerIdentity *sender,
+                 const struct GNUNET_PeerIdentity *receiver,
+                 const struct GNUNET_HashCode *key_material,
+                 struct GNUNET_CRYPTO_SymmetricSessionKey *skey)
+{
+  static const char ctx[] = "aead key generation vector";
+
+  GNUNET_CRYPTO_kdf (skey, sizeof (struct GNUNET_CRYPTO_SymmetricSessionKey),
+		     ctx, sizeof (ctx),
+		     key_material, sizeof (struct GNUNET_HashCode),
+		     sender, sizeof (struct GNUNET_PeerIdentity),
+		     receiver, sizeof (struct GNUNET_PeerIdentity),
+		     NULL);
+}
+
+
 /**
  * Encrypt size bytes from @a in and write the result to @a out.  Use the
  * @a kx key for outbound traffic of the given neighbour.
@@ -565,9 +726,15 @@ do_encrypt (struct GSC_KeyExchangeInfo *kx,
     GNUNET_break (0);
     return GNUNET_NO;
   }
+  if (NULL == kx->encrypt_ctx)
+    kx->encrypt_ctx = GNUNET_CRYPTO_symmetric_context_create (&kx->encrypt_key);
+  else
+    GNUNET_CRYPTO_symmetric_context_set_key (kx->encrypt_ctx,
+                                             &kx->encrypt_key);
   GNUNET_assert (size ==
-                 GNUNET_CRYPTO_symmetric_encrypt (in, (uint16_t) size,
-                                            &kx->encrypt_key, iv, out));
+                 GNUNET_CRYPTO_symmetric_context_encrypt (kx->encrypt_ctx,
+                                                          in, (uint16_t) size,
+                                                          iv, out));
   GNUNET_STATISTICS_update (GSC_stats, gettext_noop ("# bytes encrypted"), size,
                             GNUNET_NO);
   /* the following is too sensitive to write to log files by accident,
@@ -616,12 +783,17 @@ do_decrypt (struct GSC_KeyExchangeInfo *kx,
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
   }
+  if (NULL == kx->decrypt_ctx)
+    kx->decrypt_ctx = GNUNET_CRYPTO_symmetric_context_create (&kx->decrypt_key);
+  else
+    GNUNET_CRYPTO_symmetric_context_set_key (kx->decrypt_ctx,
+                                             &kx->decrypt_key);
   if (size !=
-      GNUNET_CRYPTO_symmetric_decrypt (in,
-                                       (uint16_t) size,
-                                       &kx->decrypt_key,
-                                       iv,
-                                       out))
+      GNUNET_CRYPTO_symmetric_context_decrypt (kx->decrypt_ctx,
+                                               in,
+                                               (uint16_t) size,
+                                               iv,
+                                               out))
   {
     GNUNET_break (0);
     return GNUNET_SYSERR;
@@ -699,6 +871,87 @@ setup_fresh_ping (struct GSC_KeyExchangeInfo *kx)
 }
 
 
+/**
+ * Job for verifying an EPHEMERAL_KEY message and doing the ECDH
+ * with its key in the crypto offload pool.
+ */
+struct EphemeralKeyJob
+{
+
+  /**
+   * Key exchange the message was received on.
+   */
+  struct GSC_KeyExchangeInfo *kx;
+
+  /**
+   * Handle of the job in the offload pool.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Copy of the message being processed.
+   */
+  struct EphemeralKeyMessage ekm;
+
+  /**
+   * Copy of our ephemeral key at the time the job was started.
+   */
+  struct GNUNET_CRYPTO_EcdhePrivateKey my_key;
+
+  /**
+   * Key material derived by the job.
+   */
+  struct GNUNET_HashCode key_material;
+
+};
+
+
+/**
+ * Update the statistic on the number of KX jobs in the crypto pool.
+ *
+ * @param delta change to apply (+1 or -1)
+ */
+static void
+update_kx_jobs (int delta)
+{
+  kx_jobs_pending += delta;
+  GNUNET_STATISTICS_set (GSC_stats,
+                         gettext_noop ("# KX jobs in crypto pool"),
+                         kx_jobs_pending,
+                         GNUNET_NO);
+}
+
+
+/**
+ * Cancel all crypto jobs and the staggered rekey of @a kx.
+ *
+ * @param kx key exchange to clean up
+ */
+static void
+cancel_kx_jobs (struct GSC_KeyExchangeInfo *kx)
+{
+  if (NULL != kx->ekm_job)
+  {
+    GNUNET_CRYPTO_offload_cancel (kx->ekm_job->job);
+    memset (kx->ekm_job, 0, sizeof (struct EphemeralKeyJob));
+    GNUNET_free (kx->ekm_job);
+    kx->ekm_job = NULL;
+    update_kx_jobs (-1);
+  }
+  if (NULL != kx->ecdh_job)
+  {
+    GNUNET_CRYPTO_offload_cancel (kx->ecdh_job);
+    kx->ecdh_job = NULL;
+    update_kx_jobs (-1);
+  }
+  if (NULL != kx->stagger_task)
+  {
+    GNUNET_SCHEDULER_cancel (kx->stagger_task);
+    kx->stagger_task = NULL;
+  }
+}
+
+
 /**
  * Start the key exchange with the given peer.
  *
@@ -722,6 +975,8 @@ GSC_KX_start (const struct GNUNET_PeerIdentity *pid)
   kx = GNUNET_new (struct GSC_KeyExchangeInfo);
   kx->peer = *pid;
   kx->set_key_retry_frequency = INITIAL_SET_KEY_RETRY_FREQUENCY;
+  kx->aead_nonce_prefix = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                                    UINT32_MAX);
   GNUNET_CONTAINER_DLL_insert (kx_head,
 			       kx_tail,
 			       kx);
@@ -774,11 +1029,32 @@ GSC_KX_stop (struct GSC_KeyExchangeInfo *kx)
     GNUNET_SCHEDULER_cancel (kx->keep_alive_task);
     kx->keep_alive_task = NULL;
   }
+  cancel_kx_jobs (kx);
   kx->status = GNUNET_CORE_KX_PEER_DISCONNECT;
   monitor_notify_all (kx);
   GNUNET_CONTAINER_DLL_remove (kx_head,
 			       kx_tail,
 			       kx);
+  if (NULL != kx->encrypt_ctx)
+  {
+    GNUNET_CRYPTO_symmetric_context_destroy (kx->encrypt_ctx);
+    kx->encrypt_ctx = NULL;
+  }
+  if (NULL != kx->decrypt_ctx)
+  {
+    GNUNET_CRYPTO_symmetric_context_destroy (kx->decrypt_ctx);
+    kx->decrypt_ctx = NULL;
+  }
+  if (NULL != kx->aead_encrypt_ctx)
+  {
+    GNUNET_CRYPTO_aead_context_destroy (kx->aead_encrypt_ctx);
+    kx->aead_encrypt_ctx = NULL;
+  }
+  if (NULL != kx->aead_decrypt_ctx)
+  {
+    GNUNET_CRYPTO_aead_context_destroy (kx->aead_decrypt_ctx);
+    kx->aead_decrypt_ctx = NULL;
+  }
   GNUNET_free (kx);
 }
 
@@ -802,32 +1078,46 @@ send_ping (struct GSC_KeyExchangeInfo *kx)
 
 
 /**
- * Derive fresh session keys from the current ephemeral keys.
+ * Derive fresh session keys from the ECDH of the current ephemeral
+ * keys.
  *
  * @param kx session to derive keys for
+ * @param key_material result of the ECDH of our and the other
+ *        peer's ephemeral key
  */
 static void
-derive_session_keys (struct GSC_KeyExchangeInfo *kx)
+derive_session_keys (struct GSC_KeyExchangeInfo *kx,
+                     const struct GNUNET_HashCode *key_material)
 {
-  struct GNUNET_HashCode key_material;
+  struct GNUNET_CRYPTO_SymmetricSessionKey aead_key;
 
-  if (GNUNET_OK !=
-      GNUNET_CRYPTO_ecc_ecdh (my_ephemeral_key,
-			      &kx->other_ephemeral_key,
-			      &key_material))
-  {
-    GNUNET_break (0);
-    return;
-  }
   derive_aes_key (&GSC_my_identity,
 		  &kx->peer,
-		  &key_material,
+		  key_material,
 		  &kx->encrypt_key);
   derive_aes_key (&kx->peer,
 		  &GSC_my_identity,
-		  &key_material,
+		  key_material,
 		  &kx->decrypt_key);
-  memset (&key_material, 0, sizeof (key_material));
+  derive_aead_key (&GSC_my_identity,
+                   &kx->peer,
+                   key_material,
+                   &aead_key);
+  if (NULL == kx->aead_encrypt_ctx)
+    kx->aead_encrypt_ctx = GNUNET_CRYPTO_aead_context_create (&aead_key);
+  else
+    GNUNET_CRYPTO_aead_context_set_key (kx->aead_encrypt_ctx,
+                                        &aead_key);
+  derive_aead_key (&kx->peer,
+                   &GSC_my_identity,
+                   key_material,
+                   &aead_key);
+  if (NULL == kx->aead_decrypt_ctx)
+    kx->aead_decrypt_ctx = GNUNET_CRYPTO_aead_context_create (&aead_key);
+  else
+    GNUNET_CRYPTO_aead_context_set_key (kx->aead_decrypt_ctx,
+                                        &aead_key);
+  memset (&aead_key, 0, sizeof (aead_key));
   /* fresh key, reset sequence numbers */
   kx->last_sequence_number_received = 0;
   kx->last_packets_bitmap = 0;
@@ -836,9 +1126,84 @@ derive_session_keys (struct GSC_KeyExchangeInfo *kx)
 
 
 /**
- * We received a SET_KEY message.  Validate and update
+ * Verify the signature of an EPHEMERAL_KEY message and derive the
+ * key material.  Runs in a worker thread.
+ *
+ * @param cls the `struct EphemeralKeyJob`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the signature is
+ *         invalid, #GNUNET_NO if the ECDH failed
+ */
+static int
+ephemeral_key_work (void *cls)
+{
+  struct EphemeralKeyJob *ej = cls;
+
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_eddsa_verify_nolog (GNUNET_SIGNATURE_PURPOSE_SET_ECC_KEY,
+                                        &ej->ekm.purpose,
+                                        &ej->ekm.signature,
+                                        &ej->ekm.origin_identity.public_key))
+    return GNUNET_SYSERR;
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_ecc_ecdh (&ej->my_key,
+                              &ej->ekm.ephemeral_key,
+                              &ej->key_material))
+    return GNUNET_NO;
+  return GNUNET_OK;
+}
+
+
+/**
+ * The crypto pool is done with an EPHEMERAL_KEY message, update
  * our key material and status.
  *
+ * @param cls the `struct EphemeralKeyJob`
+ * @param result result of #ephemeral_key_work()
+ */
+static void
+ephemeral_key_done (void *cls,
+                    int result);
+
+
+/**
+ * Start verifying an EPHEMERAL_KEY message in the crypto pool,
+ * replacing any job still running for @a kx.
+ *
+ * @param kx key exchange the message was received on
+ * @param m the message (already checked for size and origin)
+ */
+static void
+start_ephemeral_key_job (struct GSC_KeyExchangeInfo *kx,
+                         const struct EphemeralKeyMessage *m)
+{
+  struct EphemeralKeyJob *ej;
+
+  if (NULL != kx->ekm_job)
+  {
+    GNUNET_CRYPTO_offload_cancel (kx->ekm_job->job);
+    memset (kx->ekm_job, 0, sizeof (struct EphemeralKeyJob));
+    GNUNET_free (kx->ekm_job);
+    kx->ekm_job = NULL;
+    update_kx_jobs (-1);
+  }
+  ej = GNUNET_new (struct EphemeralKeyJob);
+  ej->kx = kx;
+  ej->ekm = *m;
+  ej->my_key = *my_ephemeral_key;
+  kx->ekm_job = ej;
+  update_kx_jobs (1);
+  ej->job = GNUNET_CRYPTO_offload (&ephemeral_key_work,
+                                   ej,
+                                   &ephemeral_key_done,
+                                   ej);
+}
+
+
+/**
+ * We received a SET_KEY message.  Check it and pass it on to the
+ * crypto pool for signature verification and key derivation; the
+ * key exchange continues in #ephemeral_key_done().
+ *
  * @param kx key exchange status for the corresponding peer
  * @param msg the set key message we received
  */
@@ -850,7 +1215,6 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
   struct GNUNET_TIME_Absolute start_t;
   struct GNUNET_TIME_Absolute end_t;
   struct GNUNET_TIME_Absolute now;
-  enum GNUNET_CORE_KxState sender_status;
   uint16_t size;
 
   size = ntohs (msg->size);
@@ -892,22 +1256,17 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Core service receives EPHEMERAL_KEY request from `%s'.\n",
               GNUNET_i2s (&kx->peer));
-  if ((ntohl (m->purpose.size) !=
-       sizeof (struct GNUNET_CRYPTO_EccSignaturePurpose) +
-       sizeof (struct GNUNET_TIME_AbsoluteNBO) +
-       sizeof (struct GNUNET_TIME_AbsoluteNBO) +
-       sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
-       sizeof (struct GNUNET_CRYPTO_EddsaPublicKey)) ||
-      (GNUNET_OK !=
-       GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_SET_ECC_KEY,
-                                   &m->purpose,
-                                   &m->signature,
-                                   &m->origin_identity.public_key)))
+  if (ntohl (m->purpose.size) !=
+      sizeof (struct GNUNET_CRYPTO_EccSignaturePurpose) +
+      sizeof (struct GNUNET_TIME_AbsoluteNBO) +
+      sizeof (struct GNUNET_TIME_AbsoluteNBO) +
+      sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
+      sizeof (struct GNUNET_CRYPTO_EddsaPublicKey))
   {
-    /* invalid signature */
     GNUNET_break_op (0);
     return;
   }
+  /* check the validity range before spending time on the signature */
   now = GNUNET_TIME_absolute_get ();
   if ( (end_t.abs_value_us < GNUNET_TIME_absolute_subtract (now, REKEY_TOLERANCE).abs_value_us) ||
        (start_t.abs_value_us > GNUNET_TIME_absolute_add (now, REKEY_TOLERANCE).abs_value_us) )
@@ -920,15 +1279,62 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
 		end_t.abs_value_us);
     return;
   }
+  start_ephemeral_key_job (kx, m);
+}
+
+
+/**
+ * The crypto pool is done with an EPHEMERAL_KEY message, update
+ * our key material and status.
+ *
+ * @param cls the `struct EphemeralKeyJob`
+ * @param result result of #ephemeral_key_work()
+ */
+static void
+ephemeral_key_done (void *cls,
+                    int result)
+{
+  struct EphemeralKeyJob *ej = cls;
+  struct GSC_KeyExchangeInfo *kx = ej->kx;
+  const struct EphemeralKeyMessage *m = &ej->ekm;
+  struct GNUNET_TIME_Absolute end_t;
+  enum GNUNET_CORE_KxState sender_status;
+  int key_needed;
+
+  kx->ekm_job = NULL;
+  update_kx_jobs (-1);
+  if (GNUNET_SYSERR == result)
+  {
+    /* invalid signature */
+    GNUNET_break_op (0);
+    memset (ej, 0, sizeof (struct EphemeralKeyJob));
+    GNUNET_free (ej);
+    return;
+  }
+  if (GNUNET_OK != result)
+  {
+    GNUNET_break (0);
+    memset (ej, 0, sizeof (struct EphemeralKeyJob));
+    GNUNET_free (ej);
+    return;
+  }
+  end_t = GNUNET_TIME_absolute_ntoh (m->expiration_time);
+  /* a staggered rekey for this peer that did not finish yet is
+     superseded by this exchange, but the peer needs our new key */
+  key_needed = (NULL != kx->stagger_task) || (NULL != kx->ecdh_job);
+  cancel_kx_jobs (kx);
   kx->other_ephemeral_key = m->ephemeral_key;
   kx->foreign_key_expires = end_t;
-  derive_session_keys (kx);
+  derive_session_keys (kx,
+                       &ej->key_material);
   GNUNET_STATISTICS_update (GSC_stats,
                             gettext_noop ("# EPHEMERAL_KEY messages received"), 1,
                             GNUNET_NO);
 
   /* check if we still need to send the sender our key */
   sender_status = (enum GNUNET_CORE_KxState) ntohl (m->sender_status);
+  memset (ej, 0, sizeof (struct EphemeralKeyJob));
+  GNUNET_free (ej);
   switch (sender_status)
   {
   case GNUNET_CORE_KX_STATE_DOWN:
@@ -937,6 +1343,7 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
   case GNUNET_CORE_KX_STATE_KEY_SENT:
     /* fine, need to send our key after updating our status, see below */
     GSC_SESSIONS_reinit (&kx->peer);
+    key_needed = GNUNET_YES;
     break;
   case GNUNET_CORE_KX_STATE_KEY_RECEIVED:
     /* other peer already got our key, but typemap did go down */
@@ -959,7 +1366,7 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
     GNUNET_assert (NULL == kx->keep_alive_task);
     kx->status = GNUNET_CORE_KX_STATE_KEY_RECEIVED;
     monitor_notify_all (kx);
-    if (GNUNET_CORE_KX_STATE_KEY_SENT == sender_status)
+    if (GNUNET_YES == key_needed)
       send_key (kx);
     else
       send_ping (kx);
@@ -968,14 +1375,14 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
     GNUNET_assert (NULL == kx->keep_alive_task);
     kx->status = GNUNET_CORE_KX_STATE_KEY_RECEIVED;
     monitor_notify_all (kx);
-    if (GNUNET_CORE_KX_STATE_KEY_SENT == sender_status)
+    if (GNUNET_YES == key_needed)
       send_key (kx);
     else
       send_ping (kx);
     break;
   case GNUNET_CORE_KX_STATE_KEY_RECEIVED:
     GNUNET_assert (NULL == kx->keep_alive_task);
-    if (GNUNET_CORE_KX_STATE_KEY_SENT == sender_status)
+    if (GNUNET_YES == key_needed)
       send_key (kx);
     else
       send_ping (kx);
@@ -983,13 +1390,13 @@ GSC_KX_handle_ephemeral_key (struct GSC_KeyExchangeInfo *kx,
   case GNUNET_CORE_KX_STATE_UP:
     kx->status = GNUNET_CORE_KX_STATE_REKEY_SENT;
     monitor_notify_all (kx);
-    if (GNUNET_CORE_KX_STATE_KEY_SENT == sender_status)
+    if (GNUNET_YES == key_needed)
       send_key (kx);
     else
       send_ping (kx);
     break;
   case GNUNET_CORE_KX_STATE_REKEY_SENT:
-    if (GNUNET_CORE_KX_STATE_KEY_SENT == sender_status)
+    if (GNUNET_YES == key_needed)
       send_key (kx);
     else
       send_ping (kx);
@@ -1072,7 +1479,7 @@ GSC_KX_handle_ping (struct GSC_KeyExchangeInfo *kx,
     return;
   }
   /* construct PONG */
-  tx.reserved = 0;
+  tx.flags = htonl (KX_CAPABILITY_AEAD);
   tx.challenge = t.challenge;
   tx.target = t.target;
   tp.header.type = htons (GNUNET_MESSAGE_TYPE_CORE_PONG);
@@ -1273,6 +1680,9 @@ GSC_KX_handle_pong (struct GSC_KeyExchangeInfo *kx,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received PONG from `%s'\n",
               GNUNET_i2s (&kx->peer));
+  kx->peer_aead = (0 != (ntohl (t.flags) & KX_CAPABILITY_AEAD))
+    ? GNUNET_YES
+    : GNUNET_NO;
   /* no need to resend key any longer */
   if (NULL != kx->retry_set_key_task)
   {
@@ -1353,6 +1763,64 @@ send_key (struct GSC_KeyExchangeInfo *kx)
 }
 
 
+/**
+ * Encrypt and authenticate a message with the given payload in
+ * place using AES-GCM and transmit it.  Only used if the other
+ * peer announced #KX_CAPABILITY_AEAD.
+ *
+ * @param kx key exchange context
+ * @param payload payload of the message
+ * @param payload_size number of bytes in @a payload
+ */
+static void
+encrypt_and_transmit_aead (struct GSC_KeyExchangeInfo *kx,
+                           const void *payload,
+                           size_t payload_size)
+{
+  size_t used = payload_size + sizeof (struct EncryptedAeadMessage);
+  char buf[used] GNUNET_ALIGN;
+  struct EncryptedAeadMessage *em;
+  uint32_t prefix;
+  uint64_t counter;
+
+  em = (struct EncryptedAeadMessage *) buf;
+  em->header.size = htons (used);
+  em->header.type = htons (GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_AEAD_MESSAGE);
+  prefix = htonl (kx->aead_nonce_prefix);
+  counter = GNUNET_htonll (kx->aead_nonce_counter++);
+  memcpy (em->nonce,
+          &prefix,
+          sizeof (prefix));
+  memcpy (&em->nonce[sizeof (prefix)],
+          &counter,
+          sizeof (counter));
+  em->sequence_number = htonl (++kx->last_sequence_number_sent);
+  em->reserved = 0;
+  em->timestamp = GNUNET_TIME_absolute_hton (GNUNET_TIME_absolute_get ());
+  memcpy (&em[1],
+          payload,
+          payload_size);
+  GNUNET_CRYPTO_aead_encrypt (kx->aead_encrypt_ctx,
+                              em->nonce,
+                              em,
+                              AEAD_AAD_SIZE,
+                              &em->sequence_number,
+                              used - AEAD_HEADER_SIZE,
+                              em->tag);
+  GNUNET_STATISTICS_update (GSC_stats,
+                            gettext_noop ("# bytes encrypted"),
+                            used - AEAD_HEADER_SIZE,
+                            GNUNET_NO);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Encrypted %u bytes for %s (AEAD)\n",
+              (unsigned int) (used - AEAD_HEADER_SIZE),
+              GNUNET_i2s (&kx->peer));
+  GSC_NEIGHBOURS_transmit (&kx->peer,
+                           &em->header,
+                           GNUNET_TIME_UNIT_FOREVER_REL);
+}
+
+
 /**
  * Encrypt and transmit a message with the given payload.
  *
@@ -1373,6 +1841,14 @@ GSC_KX_encrypt_and_transmit (struct GSC_KeyExchangeInfo *kx,
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
   struct GNUNET_CRYPTO_AuthKey auth_key;
 
+  if ( (GNUNET_YES == kx->peer_aead) &&
+       (NULL != kx->aead_encrypt_ctx) )
+  {
+    encrypt_and_transmit_aead (kx,
+                               payload,
+                               payload_size);
+    return;
+  }
   ph = (struct EncryptedMessage *) pbuf;
   ph->sequence_number = htonl (++kx->last_sequence_number_sent);
   ph->iv_seed = calculate_seed (kx);
@@ -1432,41 +1908,23 @@ struct DeliverMessageContext
 
 
 /**
- * We received an encrypted message.  Decrypt, validate and
- * pass on to the appropriate clients.
+ * Check that we can accept encrypted messages from the other peer
+ * of @a kx.  If the foreign key has expired, tear the session down
+ * and restart the key exchange.
  *
- * @param kx key exchange context for encrypting the message
- * @param msg encrypted message
+ * @param kx key exchange context
+ * @return #GNUNET_OK if encrypted messages are acceptable
  */
-void
-GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
-                                 const struct GNUNET_MessageHeader *msg)
+static int
+check_session_receive (struct GSC_KeyExchangeInfo *kx)
 {
-  const struct EncryptedMessage *m;
-  struct EncryptedMessage *pt;  /* plaintext */
-  struct GNUNET_HashCode ph;
-  uint32_t snum;
-  struct GNUNET_TIME_Absolute t;
-  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
-  struct GNUNET_CRYPTO_AuthKey auth_key;
-  struct DeliverMessageContext dmc;
-  uint16_t size = ntohs (msg->size);
-  char buf[size] GNUNET_ALIGN;
-
-  if (size <
-      sizeof (struct EncryptedMessage) + sizeof (struct GNUNET_MessageHeader))
-  {
-    GNUNET_break_op (0);
-    return;
-  }
-  m = (const struct EncryptedMessage *) msg;
   if (GNUNET_CORE_KX_STATE_UP != kx->status)
   {
     GNUNET_STATISTICS_update (GSC_stats,
                               gettext_noop ("# DATA message dropped (out of order)"),
                               1,
                               GNUNET_NO);
-    return;
+    return GNUNET_NO;
   }
   if (0 == GNUNET_TIME_absolute_get_remaining (kx->foreign_key_expires).rel_value_us)
   {
@@ -1485,47 +1943,35 @@ GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
     kx->status = GNUNET_CORE_KX_STATE_KEY_SENT;
     monitor_notify_all (kx);
     send_key (kx);
-    return;
+    return GNUNET_NO;
   }
+  return GNUNET_OK;
+}
 
-  /* validate hash */
-  derive_auth_key (&auth_key,
-                   &kx->decrypt_key,
-                   m->iv_seed);
-  GNUNET_CRYPTO_hmac (&auth_key,
-                      &m->sequence_number,
-                      size - ENCRYPTED_HEADER_SIZE,
-                      &ph);
-  if (0 != memcmp (&ph,
-                   &m->hmac,
-                   sizeof (struct GNUNET_HashCode)))
-  {
-    /* checksum failed */
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Failed checksum validation for a message from `%s'\n",
-		GNUNET_i2s (&kx->peer));
-    return;
-  }
-  derive_iv (&iv,
-             &kx->decrypt_key,
-             m->iv_seed,
-             &GSC_my_identity);
-  /* decrypt */
-  if (GNUNET_OK !=
-      do_decrypt (kx,
-                  &iv,
-                  &m->sequence_number,
-                  &buf[ENCRYPTED_HEADER_SIZE],
-                  size - ENCRYPTED_HEADER_SIZE))
-    return;
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Decrypted %u bytes from %s\n",
-              size - ENCRYPTED_HEADER_SIZE,
-              GNUNET_i2s (&kx->peer));
-  pt = (struct EncryptedMessage *) buf;
+
+/**
+ * Validate sequence number and timestamp of a decrypted and
+ * authenticated message and pass its payload on to the
+ * appropriate clients.
+ *
+ * @param kx key exchange context the message was received on
+ * @param snum sequence number of the message
+ * @param t timestamp of the message
+ * @param payload decrypted payload
+ * @param payload_size number of bytes in @a payload
+ * @param size size of the message on the wire
+ */
+static void
+process_decrypted (struct GSC_KeyExchangeInfo *kx,
+                   uint32_t snum,
+                   struct GNUNET_TIME_Absolute t,
+                   const char *payload,
+                   size_t payload_size,
+                   uint16_t size)
+{
+  struct DeliverMessageContext dmc;
 
   /* validate sequence number */
-  snum = ntohl (pt->sequence_number);
   if (kx->last_sequence_number_received == snum)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1577,7 +2023,6 @@ GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
   }
 
   /* check timestamp */
-  t = GNUNET_TIME_absolute_ntoh (pt->timestamp);
   if (GNUNET_TIME_absolute_get_duration (t).rel_value_us >
       MAX_MESSAGE_AGE.rel_value_us)
   {
@@ -1596,20 +2041,156 @@ GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
   update_timeout (kx);
   GNUNET_STATISTICS_update (GSC_stats,
                             gettext_noop ("# bytes of payload decrypted"),
-                            size - sizeof (struct EncryptedMessage),
+                            payload_size,
                             GNUNET_NO);
   dmc.kx = kx;
   dmc.peer = &kx->peer;
   if (GNUNET_OK !=
       GNUNET_SERVER_mst_receive (mst, &dmc,
-                                 &buf[sizeof (struct EncryptedMessage)],
-                                 size - sizeof (struct EncryptedMessage),
+                                 payload,
+                                 payload_size,
                                  GNUNET_YES,
                                  GNUNET_NO))
     GNUNET_break_op (0);
 }
 
 
+/**
+ * We received an encrypted message.  Decrypt, validate and
+ * pass on to the appropriate clients.
+ *
+ * @param kx key exchange context for encrypting the message
+ * @param msg encrypted message
+ */
+void
+GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
+                                 const struct GNUNET_MessageHeader *msg)
+{
+  const struct EncryptedMessage *m;
+  struct EncryptedMessage *pt;  /* plaintext */
+  struct GNUNET_HashCode ph;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  struct GNUNET_CRYPTO_AuthKey auth_key;
+  uint16_t size = ntohs (msg->size);
+  char buf[size] GNUNET_ALIGN;
+
+  if (size <
+      sizeof (struct EncryptedMessage) + sizeof (struct GNUNET_MessageHeader))
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  m = (const struct EncryptedMessage *) msg;
+  if (GNUNET_OK != check_session_receive (kx))
+    return;
+
+  /* validate hash */
+  derive_auth_key (&auth_key,
+                   &kx->decrypt_key,
+                   m->iv_seed);
+  GNUNET_CRYPTO_hmac (&auth_key,
+                      &m->sequence_number,
+                      size - ENCRYPTED_HEADER_SIZE,
+                      &ph);
+  if (0 != memcmp (&ph,
+                   &m->hmac,
+                   sizeof (struct GNUNET_HashCode)))
+  {
+    /* checksum failed */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Failed checksum validation for a message from `%s'\n",
+		GNUNET_i2s (&kx->peer));
+    return;
+  }
+  derive_iv (&iv,
+             &kx->decrypt_key,
+             m->iv_seed,
+             &GSC_my_identity);
+  /* decrypt */
+  if (GNUNET_OK !=
+      do_decrypt (kx,
+                  &iv,
+                  &m->sequence_number,
+                  &buf[ENCRYPTED_HEADER_SIZE],
+                  size - ENCRYPTED_HEADER_SIZE))
+    return;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Decrypted %u bytes from %s\n",
+              size - ENCRYPTED_HEADER_SIZE,
+              GNUNET_i2s (&kx->peer));
+  pt = (struct EncryptedMessage *) buf;
+  process_decrypted (kx,
+                     ntohl (pt->sequence_number),
+                     GNUNET_TIME_absolute_ntoh (pt->timestamp),
+                     &buf[sizeof (struct EncryptedMessage)],
+                     size - sizeof (struct EncryptedMessage),
+                     size);
+}
+
+
+/**
+ * We received an AEAD encrypted message.  Authenticate and decrypt
+ * it in place in a single pass, validate and pass on to the
+ * appropriate clients.
+ *
+ * @param kx key exchange context for encrypting the message
+ * @param msg encrypted message
+ */
+void
+GSC_KX_handle_encrypted_aead_message (struct GSC_KeyExchangeInfo *kx,
+                                      const struct GNUNET_MessageHeader *msg)
+{
+  struct EncryptedAeadMessage *pt;  /* plaintext */
+  uint16_t size = ntohs (msg->size);
+  char buf[size] GNUNET_ALIGN;
+
+  if (size <
+      sizeof (struct EncryptedAeadMessage) + sizeof (struct GNUNET_MessageHeader))
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  if (GNUNET_OK != check_session_receive (kx))
+    return;
+  if (NULL == kx->aead_decrypt_ctx)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  memcpy (buf, msg, size);
+  pt = (struct EncryptedAeadMessage *) buf;
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_aead_decrypt (kx->aead_decrypt_ctx,
+                                  pt->nonce,
+                                  pt,
+                                  AEAD_AAD_SIZE,
+                                  &pt->sequence_number,
+                                  size - AEAD_HEADER_SIZE,
+                                  pt->tag))
+  {
+    /* checksum failed */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Failed checksum validation for a message from `%s'\n",
+		GNUNET_i2s (&kx->peer));
+    return;
+  }
+  GNUNET_STATISTICS_update (GSC_stats,
+                            gettext_noop ("# bytes decrypted"),
+                            size - AEAD_HEADER_SIZE,
+                            GNUNET_NO);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Decrypted %u bytes from %s\n",
+              size - AEAD_HEADER_SIZE,
+              GNUNET_i2s (&kx->peer));
+  process_decrypted (kx,
+                     ntohl (pt->sequence_number),
+                     GNUNET_TIME_absolute_ntoh (pt->timestamp),
+                     &buf[sizeof (struct EncryptedAeadMessage)],
+                     size - sizeof (struct EncryptedAeadMessage),
+                     size);
+}
+
+
 /**
  * Deliver P2P message to interested clients.
  * Invokes send twice, once for clients that want the full message, and once
@@ -1640,6 +2221,9 @@ deliver_message (void *cls,
   case GNUNET_MESSAGE_TYPE_CORE_COMPRESSED_TYPE_MAP:
     GSC_SESSIONS_set_typemap (dmc->peer, m);
     return GNUNET_OK;
+  case GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP:
+    GSC_SESSIONS_update_typemap (dmc->peer, m);
+    return GNUNET_OK;
   case GNUNET_MESSAGE_TYPE_CORE_CONFIRM_TYPE_MAP:
     GSC_SESSIONS_confirm_typemap (dmc->peer, m);
     return GNUNET_OK;
@@ -1694,6 +2278,74 @@ sign_ephemeral_key ()
 }
 
 
+/**
+ * The crypto pool derived the key material with our new ephemeral
+ * key for a peer we are rekeying; update the session keys and send
+ * the new key.
+ *
+ * @param cls the `struct GSC_KeyExchangeInfo`
+ * @param key_material the key material, NULL on error
+ */
+static void
+rekey_ecdh_done (void *cls,
+                 const struct GNUNET_HashCode *key_material)
+{
+  struct GSC_KeyExchangeInfo *kx = cls;
+
+  kx->ecdh_job = NULL;
+  update_kx_jobs (-1);
+  if (NULL == key_material)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  derive_session_keys (kx,
+                       key_material);
+  send_key (kx);
+}
+
+
+/**
+ * Task run to rekey a single peer after we created a new ephemeral
+ * key.  Peers are rekeyed at random times spread over
+ * #REKEY_STAGGER to avoid a CPU spike.
+ *
+ * @param cls the `struct GSC_KeyExchangeInfo`
+ * @param tc scheduler context
+ */
+static void
+rekey_peer (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GSC_KeyExchangeInfo *kx = cls;
+
+  kx->stagger_task = NULL;
+  if (GNUNET_CORE_KX_STATE_UP == kx->status)
+  {
+    kx->status = GNUNET_CORE_KX_STATE_REKEY_SENT;
+    monitor_notify_all (kx);
+    if (NULL != kx->ecdh_job)
+    {
+      GNUNET_CRYPTO_offload_cancel (kx->ecdh_job);
+      update_kx_jobs (-1);
+    }
+    update_kx_jobs (1);
+    kx->ecdh_job = GNUNET_CRYPTO_ecc_ecdh_offload (my_ephemeral_key,
+                                                   &kx->other_ephemeral_key,
+                                                   &rekey_ecdh_done,
+                                                   kx);
+    return;
+  }
+  if (GNUNET_CORE_KX_STATE_DOWN == kx->status)
+  {
+    kx->status = GNUNET_CORE_KX_STATE_KEY_SENT;
+    monitor_notify_all (kx);
+  }
+  monitor_notify_all (kx);
+  send_key (kx);
+}
+
+
 /**
  * Task run to trigger rekeying.
  *
@@ -1705,6 +2357,7 @@ do_rekey (void *cls,
 	  const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct GSC_KeyExchangeInfo *pos;
+  struct EphemeralKeyMessage m;
 
   rekey_task = GNUNET_SCHEDULER_add_delayed (REKEY_FREQUENCY,
 					     &do_rekey,
@@ -1716,19 +2369,27 @@ do_rekey (void *cls,
   sign_ephemeral_key ();
   for (pos = kx_head; NULL != pos; pos = pos->next)
   {
-    if (GNUNET_CORE_KX_STATE_UP == pos->status)
+    /* keys still being derived used our old key, start again */
+    if (NULL != pos->ekm_job)
     {
-      pos->status = GNUNET_CORE_KX_STATE_REKEY_SENT;
-      monitor_notify_all (pos);
-      derive_session_keys (pos);
+      m = pos->ekm_job->ekm;
+      start_ephemeral_key_job (pos, &m);
     }
-    if (GNUNET_CORE_KX_STATE_DOWN == pos->status)
+    if (NULL != pos->ecdh_job)
     {
-      pos->status = GNUNET_CORE_KX_STATE_KEY_SENT;
-      monitor_notify_all (pos);
+      GNUNET_CRYPTO_offload_cancel (pos->ecdh_job);
+      pos->ecdh_job = NULL;
+      update_kx_jobs (-1);
+      pos->status = GNUNET_CORE_KX_STATE_UP;
     }
-    monitor_notify_all (pos);
-    send_key (pos);
+    if (NULL != pos->stagger_task)
+      GNUNET_SCHEDULER_cancel (pos->stagger_task);
+    pos->stagger_task
+      = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                                                     GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                                                                               REKEY_STAGGER.rel_value_us / 1000LL)),
+                                      &rekey_peer,
+                                      pos);
   }
 }
 
@@ -95,6 +95,18 @@ GSC_KX_handle_encrypted_message (struct GSC_KeyExchangeInfo *kx,
                                  const struct GNUNET_MessageHeader *msg);
 
 
+/**
+ * We received an AEAD encrypted message.  Authenticate, decrypt,
+ * validate and pass on to the appropriate clients.
+ *
+ * @param kx key exchange information context
+ * @param msg encrypted message
+ */
+void
+GSC_KX_handle_encrypted_aead_message (struct GSC_KeyExchangeInfo *kx,
+                                      const struct GNUNET_MessageHeader *msg);
+
+
 /**
  * Start the key exchange with the given peer.
  *
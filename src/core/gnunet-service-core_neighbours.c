@@ -440,6 +440,9 @@ handle_transport_receive (void *cls,
   case GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_MESSAGE:
     GSC_KX_handle_encrypted_message (n->kxinfo, message);
     break;
+  case GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_AEAD_MESSAGE:
+    GSC_KX_handle_encrypted_aead_message (n->kxinfo, message);
+    break;
   case GNUNET_MESSAGE_TYPE_DUMMY:
     /*  Dummy messages for testing / benchmarking, just discard */
     break;
@@ -40,6 +40,23 @@
  */
 #define MAX_ENCRYPTED_MESSAGE_QUEUE_SIZE 4
 
+/**
+ * Number of distinct `enum GNUNET_CORE_Priority` values.
+ */
+#define PRIO_COUNT (GNUNET_CORE_PRIO_CRITICAL_CONTROL + 1)
+
+
+/**
+ * Statistics for messages that missed their deadline (expired
+ * before solicitation or transmitted late), indexed by priority.
+ */
+static const char *const missed_deadline_stats[PRIO_COUNT] = {
+  gettext_noop ("# deadlines missed (background)"),
+  gettext_noop ("# deadlines missed (best effort)"),
+  gettext_noop ("# deadlines missed (urgent)"),
+  gettext_noop ("# deadlines missed (critical control)")
+};
+
 
 /**
  * Message ready for encryption.  This struct is followed by the
@@ -65,6 +82,12 @@ struct SessionMessageEntry
    */
   struct GNUNET_TIME_Absolute deadline;
 
+  /**
+   * Deadline the client asked for in its transmission request;
+   * zero for our own control messages.
+   */
+  struct GNUNET_TIME_Absolute request_deadline;
+
   /**
    * How long is the message? (number of bytes following the `struct
    * MessageEntry`, but not including the size of `struct
@@ -103,14 +126,27 @@ struct Session
   struct GSC_ClientActiveRequest *active_client_request_tail;
 
   /**
-   * Head of list of messages ready for encryption.
+   * Requests that have not been solicited yet, one min-heap per
+   * priority ordered by the deadline of the request.
    */
-  struct SessionMessageEntry *sme_head;
+  struct GNUNET_CONTAINER_Heap *request_heap[PRIO_COUNT];
 
   /**
-   * Tail of list of messages ready for encryption.
+   * Heads of the lists of messages ready for encryption, one
+   * per priority, each sorted by deadline.
    */
-  struct SessionMessageEntry *sme_tail;
+  struct SessionMessageEntry *sme_head[PRIO_COUNT];
+
+  /**
+   * Tails of the lists of messages ready for encryption.
+   */
+  struct SessionMessageEntry *sme_tail[PRIO_COUNT];
+
+  /**
+   * Number of bytes solicited from clients (but not yet received)
+   * per priority.
+   */
+  size_t solicited_size[PRIO_COUNT];
 
   /**
    * Information about the key exchange with the other peer.
@@ -150,9 +186,33 @@ struct Session
    * we are sending for the first time, 1 if not.
    */
   int first_typemap;
+
+  /**
+   * Did the peer indicate that it understands
+   * #GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP messages?
+   */
+  int peer_tm_delta;
+
+  /**
+   * #GNUNET_YES if @e tm_version is the version of our type
+   * map that the peer confirmed last.
+   */
+  int tm_version_known;
+
+  /**
+   * Version of our type map the peer confirmed last.
+   */
+  uint32_t tm_version;
 };
 
 
+/**
+ * Flag in a `struct TypeMapConfirmationMessage` indicating that
+ * the sender can process #GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP.
+ */
+#define TYPEMAP_CONFIRM_FLAG_DELTA 1
+
+
 GNUNET_NETWORK_STRUCT_BEGIN
 
 /**
@@ -167,9 +227,10 @@ struct TypeMapConfirmationMessage
   struct GNUNET_MessageHeader header;
 
   /**
-   * Reserved, always zero.
+   * Bitmask of TYPEMAP_CONFIRM_FLAG_* values; older peers
+   * always set this to zero.
    */
-  uint32_t reserved GNUNET_PACKED;
+  uint32_t flags GNUNET_PACKED;
 
   /**
    * Hash of the (decompressed) type map that was received.
@@ -213,6 +274,7 @@ GSC_SESSIONS_end (const struct GNUNET_PeerIdentity *pid)
   struct Session *session;
   struct GSC_ClientActiveRequest *car;
   struct SessionMessageEntry *sme;
+  unsigned int i;
 
   session = find_session (pid);
   if (NULL == session)
@@ -229,14 +291,23 @@ GSC_SESSIONS_end (const struct GNUNET_PeerIdentity *pid)
   {
     GNUNET_CONTAINER_DLL_remove (session->active_client_request_head,
                                  session->active_client_request_tail, car);
+    if (NULL != car->hn)
+    {
+      GNUNET_CONTAINER_heap_remove_node (car->hn);
+      car->hn = NULL;
+    }
     GSC_CLIENTS_reject_request (car);
   }
-  while (NULL != (sme = session->sme_head))
+  for (i = 0; i < PRIO_COUNT; i++)
   {
-    GNUNET_CONTAINER_DLL_remove (session->sme_head,
-                                 session->sme_tail,
-                                 sme);
-    GNUNET_free (sme);
+    while (NULL != (sme = session->sme_head[i]))
+    {
+      GNUNET_CONTAINER_DLL_remove (session->sme_head[i],
+                                   session->sme_tail[i],
+                                   sme);
+      GNUNET_free (sme);
+    }
+    GNUNET_CONTAINER_heap_destroy (session->request_heap[i]);
   }
   if (NULL != session->typemap_task)
   {
@@ -258,6 +329,35 @@ GSC_SESSIONS_end (const struct GNUNET_PeerIdentity *pid)
 }
 
 
+/**
+ * Compute the type map message to send to the given peer: a delta
+ * against the version it confirmed last if possible, the full map
+ * otherwise.
+ *
+ * @param session session to compute the type map message for
+ * @return type map message, to be freed by the caller
+ */
+static struct GNUNET_MessageHeader *
+compute_typemap_message (struct Session *session)
+{
+  struct GNUNET_MessageHeader *hdr;
+
+  hdr = NULL;
+  if ( (GNUNET_YES == session->peer_tm_delta) &&
+       (GNUNET_YES == session->tm_version_known) )
+    hdr = GSC_TYPEMAP_compute_delta_message (session->tm_version);
+  if (NULL != hdr)
+  {
+    GNUNET_STATISTICS_update (GSC_stats,
+                              gettext_noop ("# type map deltas sent"),
+                              1,
+                              GNUNET_NO);
+    return hdr;
+  }
+  return GSC_TYPEMAP_compute_type_map_message ();
+}
+
+
 /**
  * Transmit our current typemap message to the other peer.
  * (Done periodically until the typemap is confirmed).
@@ -285,7 +385,7 @@ transmit_typemap_task (void *cls,
                             gettext_noop ("# type map refreshes sent"),
                             1,
                             GNUNET_NO);
-  hdr = GSC_TYPEMAP_compute_type_map_message ();
+  hdr = compute_typemap_message (session);
   GSC_KX_encrypt_and_transmit (session->kxinfo,
                                hdr,
                                ntohs (hdr->size));
@@ -322,11 +422,15 @@ GSC_SESSIONS_create (const struct GNUNET_PeerIdentity *peer,
                      struct GSC_KeyExchangeInfo *kx)
 {
   struct Session *session;
+  unsigned int i;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Creating session for peer `%4s'\n",
               GNUNET_i2s (peer));
   session = GNUNET_new (struct Session);
+  for (i = 0; i < PRIO_COUNT; i++)
+    session->request_heap[i] =
+      GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   session->tmap = GSC_TYPEMAP_create ();
   session->peer = *peer;
   session->kxinfo = kx;
@@ -394,6 +498,11 @@ GSC_SESSIONS_confirm_typemap (const struct GNUNET_PeerIdentity *peer,
     return;
   }
   cmsg = (const struct TypeMapConfirmationMessage *) msg;
+  if (0 != (ntohl (cmsg->flags) & TYPEMAP_CONFIRM_FLAG_DELTA))
+    session->peer_tm_delta = GNUNET_YES;
+  session->tm_version_known
+    = GSC_TYPEMAP_get_version (&cmsg->tm_hash,
+                               &session->tm_version);
   if (GNUNET_YES !=
       GSC_TYPEMAP_check_hash (&cmsg->tm_hash))
   {
@@ -466,6 +575,43 @@ static void
 try_transmission (struct Session *session);
 
 
+/**
+ * Map a priority given by a client to the range we schedule.
+ *
+ * @param priority priority as requested
+ * @return valid priority to use
+ */
+static enum GNUNET_CORE_Priority
+clamp_priority (enum GNUNET_CORE_Priority priority)
+{
+  if ((unsigned int) priority < PRIO_COUNT)
+    return priority;
+  GNUNET_break (0);
+  return GNUNET_CORE_PRIO_CRITICAL_CONTROL;
+}
+
+
+/**
+ * Determine the highest priority of the requests waiting to be
+ * solicited from clients.
+ *
+ * @param session session to inspect
+ * @param floor priority to return if no request has a higher one
+ * @return highest priority of a waiting request, at least @a floor
+ */
+static enum GNUNET_CORE_Priority
+get_max_request_priority (const struct Session *session,
+                          enum GNUNET_CORE_Priority floor)
+{
+  unsigned int i;
+
+  for (i = PRIO_COUNT; i > (unsigned int) floor + 1; i--)
+    if (0 != GNUNET_CONTAINER_heap_get_size (session->request_heap[i - 1]))
+      return (enum GNUNET_CORE_Priority) (i - 1);
+  return floor;
+}
+
+
 /**
  * Queue a request from a client for transmission to a particular peer.
  *
@@ -497,9 +643,13 @@ GSC_SESSIONS_queue_request (struct GSC_ClientActiveRequest *car)
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received client transmission request. queueing\n");
+  car->priority = clamp_priority (car->priority);
   GNUNET_CONTAINER_DLL_insert (session->active_client_request_head,
                                session->active_client_request_tail,
                                car);
+  car->hn = GNUNET_CONTAINER_heap_insert (session->request_heap[car->priority],
+                                          car,
+                                          car->deadline.abs_value_us);
   try_transmission (session);
 }
 
@@ -524,39 +674,52 @@ GSC_SESSIONS_dequeue_request (struct GSC_ClientActiveRequest *car)
   GNUNET_CONTAINER_DLL_remove (session->active_client_request_head,
                                session->active_client_request_tail,
                                car);
+  if (NULL != car->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (car->hn);
+    car->hn = NULL;
+  }
+  else if (GNUNET_YES == car->was_solicited)
+  {
+    GNUNET_assert (session->solicited_size[car->priority] >= car->msize);
+    session->solicited_size[car->priority] -= car->msize;
+  }
 }
 
 
 /**
  * Discard all expired active transmission requests from clients.
+ * Only requests that were not yet solicited can expire, so we
+ * only need to look at the roots of the request heaps.
  *
  * @param session session to clean up
  */
 static void
 discard_expired_requests (struct Session *session)
 {
-  struct GSC_ClientActiveRequest *pos;
-  struct GSC_ClientActiveRequest *nxt;
+  struct GSC_ClientActiveRequest *car;
   struct GNUNET_TIME_Absolute now;
+  unsigned int i;
 
   now = GNUNET_TIME_absolute_get ();
-  pos = NULL;
-  nxt = session->active_client_request_head;
-  while (NULL != nxt)
+  for (i = 0; i < PRIO_COUNT; i++)
   {
-    pos = nxt;
-    nxt = pos->next;
-    if ( (pos->deadline.abs_value_us < now.abs_value_us) &&
-         (GNUNET_YES != pos->was_solicited) )
+    while ( (NULL != (car = GNUNET_CONTAINER_heap_peek (session->request_heap[i]))) &&
+            (car->deadline.abs_value_us < now.abs_value_us) )
     {
       GNUNET_STATISTICS_update (GSC_stats,
                                 gettext_noop
                                 ("# messages discarded (expired prior to transmission)"),
                                 1, GNUNET_NO);
+      GNUNET_STATISTICS_update (GSC_stats,
+                                missed_deadline_stats[i],
+                                1, GNUNET_NO);
+      GNUNET_CONTAINER_heap_remove_root (session->request_heap[i]);
+      car->hn = NULL;
       GNUNET_CONTAINER_DLL_remove (session->active_client_request_head,
                                    session->active_client_request_tail,
-                                   pos);
-      GSC_CLIENTS_reject_request (pos);
+                                   car);
+      GSC_CLIENTS_reject_request (car);
     }
   }
 }
@@ -564,7 +727,7 @@ discard_expired_requests (struct Session *session)
 
 /**
  * Solicit messages for transmission, starting with those of the highest
- * priority.
+ * priority and, within a priority, the earliest deadline.
  *
  * @param session session to solict messages for
  * @param msize how many bytes do we have already
@@ -574,31 +737,29 @@ solicit_messages (struct Session *session,
                   size_t msize)
 {
   struct GSC_ClientActiveRequest *car;
-  struct GSC_ClientActiveRequest *nxt;
+  struct GNUNET_CONTAINER_Heap *heap;
   size_t so_size;
   enum GNUNET_CORE_Priority pmax;
+  unsigned int i;
 
   discard_expired_requests (session);
+  pmax = get_max_request_priority (session,
+                                   GNUNET_CORE_PRIO_BACKGROUND);
+  heap = session->request_heap[pmax];
+  /* bytes already solicited at lower priorities do not hold
+     back more important traffic */
   so_size = msize;
-  pmax = GNUNET_CORE_PRIO_BACKGROUND;
-  for (car = session->active_client_request_head; NULL != car; car = car->next)
+  for (i = pmax; i < PRIO_COUNT; i++)
+    so_size += session->solicited_size[i];
+  while (NULL != (car = GNUNET_CONTAINER_heap_peek (heap)))
   {
-    if (GNUNET_YES == car->was_solicited)
-      continue;
-    pmax = GNUNET_MAX (pmax, car->priority);
-  }
-  nxt = session->active_client_request_head;
-  while (NULL != (car = nxt))
-  {
-    nxt = car->next;
-    if (car->priority < pmax)
-      continue;
     if (so_size + car->msize > GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE)
       break;
     so_size += car->msize;
-    if (GNUNET_YES == car->was_solicited)
-      continue;
+    GNUNET_CONTAINER_heap_remove_root (heap);
+    car->hn = NULL;
     car->was_solicited = GNUNET_YES;
+    session->solicited_size[car->priority] += car->msize;
     GSC_CLIENTS_solicit_request (car);
   }
 }
@@ -625,7 +786,8 @@ pop_cork_task (void *cls,
 /**
  * Try to perform a transmission on the given session. Will solicit
  * additional messages if the 'sme' queue is not full enough or has
- * only low-priority messages.
+ * only low-priority messages.  Ready messages are taken by priority
+ * and, within a priority, by deadline.
  *
  * @param session session to transmit messages from
  */
@@ -638,8 +800,9 @@ try_transmission (struct Session *session)
   struct GNUNET_TIME_Absolute min_deadline;
   enum GNUNET_CORE_Priority maxp;
   enum GNUNET_CORE_Priority maxpc;
-  struct GSC_ClientActiveRequest *car;
+  unsigned int i;
   int excess;
+  int full;
 
   if (GNUNET_YES != session->ready_to_transmit)
     return;
@@ -660,16 +823,22 @@ try_transmission (struct Session *session)
   else
     maxp = GNUNET_CORE_PRIO_BEST_EFFORT;
   /* determine highest priority of 'ready' messages we already solicited from clients */
-  pos = session->sme_head;
-  while ((NULL != pos) &&
-         (msize + pos->size <= GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE))
+  full = GNUNET_NO;
+  for (i = PRIO_COUNT; (i > 0) && (GNUNET_NO == full); i--)
   {
-    GNUNET_assert (pos->size < GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE);
-    msize += pos->size;
-    maxp = GNUNET_MAX (maxp, pos->priority);
-    min_deadline = GNUNET_TIME_absolute_min (min_deadline,
-                                             pos->deadline);
-    pos = pos->next;
+    for (pos = session->sme_head[i - 1]; NULL != pos; pos = pos->next)
+    {
+      if (msize + pos->size > GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE)
+      {
+        full = GNUNET_YES;
+        break;
+      }
+      GNUNET_assert (pos->size < GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE);
+      msize += pos->size;
+      maxp = GNUNET_MAX (maxp, pos->priority);
+      min_deadline = GNUNET_TIME_absolute_min (min_deadline,
+                                               pos->deadline);
+    }
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Calculating transmission set with %u priority (%s) and %s earliest deadline\n",
@@ -682,16 +851,10 @@ try_transmission (struct Session *session)
   {
     /* if highest already solicited priority from clients is not critical,
        check if there are higher-priority messages to be solicited from clients */
-    if (GNUNET_YES == excess)
-      maxpc = GNUNET_CORE_PRIO_BACKGROUND;
-    else
-      maxpc = GNUNET_CORE_PRIO_BEST_EFFORT;
-    for (car = session->active_client_request_head; NULL != car; car = car->next)
-    {
-      if (GNUNET_YES == car->was_solicited)
-        continue;
-      maxpc = GNUNET_MAX (maxpc, car->priority);
-    }
+    maxpc = get_max_request_priority (session,
+                                      (GNUNET_YES == excess)
+                                      ? GNUNET_CORE_PRIO_BACKGROUND
+                                      : GNUNET_CORE_PRIO_BEST_EFFORT);
     if (maxpc > maxp)
     {
       /* we have messages waiting for solicitation that have a higher
@@ -758,15 +921,28 @@ try_transmission (struct Session *session)
     size_t used;
 
     used = 0;
-    while ( (NULL != (pos = session->sme_head)) &&
-            (used + pos->size <= msize) )
+    full = GNUNET_NO;
+    for (i = PRIO_COUNT; (i > 0) && (GNUNET_NO == full); i--)
     {
-      memcpy (&pbuf[used], &pos[1], pos->size);
-      used += pos->size;
-      GNUNET_CONTAINER_DLL_remove (session->sme_head,
-                                   session->sme_tail,
-                                   pos);
-      GNUNET_free (pos);
+      while (NULL != (pos = session->sme_head[i - 1]))
+      {
+        if (used + pos->size > msize)
+        {
+          full = GNUNET_YES;
+          break;
+        }
+        if ( (0 != pos->request_deadline.abs_value_us) &&
+             (pos->request_deadline.abs_value_us < now.abs_value_us) )
+          GNUNET_STATISTICS_update (GSC_stats,
+                                    missed_deadline_stats[i - 1],
+                                    1, GNUNET_NO);
+        memcpy (&pbuf[used], &pos[1], pos->size);
+        used += pos->size;
+        GNUNET_CONTAINER_DLL_remove (session->sme_head[i - 1],
+                                     session->sme_tail[i - 1],
+                                     pos);
+        GNUNET_free (pos);
+      }
     }
     /* compute average payload size */
     total_bytes += used;
@@ -794,7 +970,7 @@ try_transmission (struct Session *session)
  * Send an updated typemap message to the neighbour now,
  * and restart typemap transmissions.
  *
- * @param cls the message
+ * @param cls NULL
  * @param key neighbour's identity
  * @param value `struct Neighbour` of the target
  * @return always #GNUNET_OK
@@ -804,18 +980,20 @@ do_restart_typemap_message (void *cls,
                             const struct GNUNET_PeerIdentity *key,
                             void *value)
 {
-  const struct GNUNET_MessageHeader *hdr = cls;
   struct Session *session = value;
+  struct GNUNET_MessageHeader *hdr;
   struct SessionMessageEntry *sme;
   uint16_t size;
 
+  hdr = compute_typemap_message (session);
   size = ntohs (hdr->size);
   sme = GNUNET_malloc (sizeof (struct SessionMessageEntry) + size);
   memcpy (&sme[1], hdr, size);
+  GNUNET_free (hdr);
   sme->size = size;
   sme->priority = GNUNET_CORE_PRIO_CRITICAL_CONTROL;
-  GNUNET_CONTAINER_DLL_insert (session->sme_head,
-                               session->sme_tail,
+  GNUNET_CONTAINER_DLL_insert (session->sme_head[sme->priority],
+                               session->sme_tail[sme->priority],
                                sme);
   try_transmission (session);
   start_typemap_task (session);
@@ -824,19 +1002,18 @@ do_restart_typemap_message (void *cls,
 
 
 /**
- * Broadcast an updated typemap message to all neighbours.
- * Restarts the retransmissions until the typemaps are confirmed.
- *
- * @param msg message to transmit
+ * Broadcast our updated typemap to all neighbours, as a delta
+ * to those that support it.  Restarts the retransmissions until
+ * the typemaps are confirmed.
  */
 void
-GSC_SESSIONS_broadcast_typemap (const struct GNUNET_MessageHeader *msg)
+GSC_SESSIONS_broadcast_typemap ()
 {
   if (NULL == sessions)
     return;
   GNUNET_CONTAINER_multipeermap_iterate (sessions,
                                          &do_restart_typemap_message,
-                                         (void *) msg);
+                                         NULL);
 }
 
 
@@ -887,23 +1064,53 @@ GSC_SESSIONS_transmit (struct GSC_ClientActiveRequest *car,
   sme = GNUNET_malloc (sizeof (struct SessionMessageEntry) + msize);
   memcpy (&sme[1], msg, msize);
   sme->size = msize;
-  sme->priority = priority;
+  sme->priority = clamp_priority (priority);
+  sme->request_deadline = car->deadline;
   if (GNUNET_YES == cork)
     sme->deadline =
         GNUNET_TIME_relative_to_absolute (GNUNET_CONSTANTS_MAX_CORK_DELAY);
-  pos = session->sme_head;
-  while ( (NULL != pos) &&
-          (pos->priority >= sme->priority) )
-    pos = pos->next;
-  if (NULL == pos)
-    GNUNET_CONTAINER_DLL_insert_tail (session->sme_head,
-                                      session->sme_tail,
-                                      sme);
   else
-    GNUNET_CONTAINER_DLL_insert_after (session->sme_head,
-                                       session->sme_tail,
-                                       pos->prev,
-                                       sme);
+    sme->deadline = GNUNET_TIME_absolute_get ();
+  /* keep the list sorted by deadline; new entries usually go last */
+  pos = session->sme_tail[sme->priority];
+  while ( (NULL != pos) &&
+          (pos->deadline.abs_value_us > sme->deadline.abs_value_us) )
+    pos = pos->prev;
+  GNUNET_CONTAINER_DLL_insert_after (session->sme_head[sme->priority],
+                                     session->sme_tail[sme->priority],
+                                     pos,
+                                     sme);
+  try_transmission (session);
+}
+
+
+/**
+ * Confirm to the other peer that we have the given type map of it.
+ *
+ * @param session session with the peer
+ * @param tmap the peer's type map we have
+ */
+static void
+confirm_typemap (struct Session *session,
+                 const struct GSC_TypeMap *tmap)
+{
+  struct SessionMessageEntry *sme;
+  struct TypeMapConfirmationMessage *tmc;
+
+  sme = GNUNET_malloc (sizeof (struct SessionMessageEntry) +
+                       sizeof (struct TypeMapConfirmationMessage));
+  sme->deadline = GNUNET_TIME_absolute_get ();
+  sme->size = sizeof (struct TypeMapConfirmationMessage);
+  sme->priority = GNUNET_CORE_PRIO_CRITICAL_CONTROL;
+  tmc = (struct TypeMapConfirmationMessage *) &sme[1];
+  tmc->header.size = htons (sizeof (struct TypeMapConfirmationMessage));
+  tmc->header.type = htons (GNUNET_MESSAGE_TYPE_CORE_CONFIRM_TYPE_MAP);
+  tmc->flags = htonl (TYPEMAP_CONFIRM_FLAG_DELTA);
+  GSC_TYPEMAP_hash (tmap,
+                    &tmc->tm_hash);
+  GNUNET_CONTAINER_DLL_insert (session->sme_head[sme->priority],
+                               session->sme_tail[sme->priority],
+                               sme);
   try_transmission (session);
 }
 
@@ -921,8 +1128,6 @@ GSC_SESSIONS_set_typemap (const struct GNUNET_PeerIdentity *peer,
 {
   struct Session *session;
   struct GSC_TypeMap *nmap;
-  struct SessionMessageEntry *sme;
-  struct TypeMapConfirmationMessage *tmc;
 
   nmap = GSC_TYPEMAP_get_from_message (msg);
   if (NULL == nmap)
@@ -933,21 +1138,55 @@ GSC_SESSIONS_set_typemap (const struct GNUNET_PeerIdentity *peer,
     GNUNET_break (0);
     return;
   }
-  sme = GNUNET_malloc (sizeof (struct SessionMessageEntry) +
-                       sizeof (struct TypeMapConfirmationMessage));
-  sme->deadline = GNUNET_TIME_absolute_get ();
-  sme->size = sizeof (struct TypeMapConfirmationMessage);
-  sme->priority = GNUNET_CORE_PRIO_CRITICAL_CONTROL;
-  tmc = (struct TypeMapConfirmationMessage *) &sme[1];
-  tmc->header.size = htons (sizeof (struct TypeMapConfirmationMessage));
-  tmc->header.type = htons (GNUNET_MESSAGE_TYPE_CORE_CONFIRM_TYPE_MAP);
-  tmc->reserved = htonl (0);
-  GSC_TYPEMAP_hash (nmap,
-                    &tmc->tm_hash);
-  GNUNET_CONTAINER_DLL_insert (session->sme_head,
-                               session->sme_tail,
-                               sme);
-  try_transmission (session);
+  confirm_typemap (session,
+                   nmap);
+  GSC_CLIENTS_notify_clients_about_neighbour (peer,
+                                              session->tmap,
+                                              nmap);
+  GSC_TYPEMAP_destroy (session->tmap);
+  session->tmap = nmap;
+}
+
+
+/**
+ * We have received a typemap delta from a peer, update ours.
+ * Notifies clients about the session.  If the delta does not
+ * apply, we confirm the map we do have, so that the peer can
+ * send a matching delta or its full map.
+ *
+ * @param peer peer this is about
+ * @param msg typemap delta message
+ */
+void
+GSC_SESSIONS_update_typemap (const struct GNUNET_PeerIdentity *peer,
+                             const struct GNUNET_MessageHeader *msg)
+{
+  struct Session *session;
+  struct GSC_TypeMap *nmap;
+  uint32_t version;
+
+  session = find_session (peer);
+  if (NULL == session)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  nmap = GSC_TYPEMAP_apply_delta (session->tmap,
+                                  msg,
+                                  &version);
+  if (NULL == nmap)
+  {
+    if (NULL != session->tmap)
+      confirm_typemap (session,
+                       session->tmap);
+    return;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Peer `%s' updated its type map to version %u\n",
+              GNUNET_i2s (peer),
+              (unsigned int) version);
+  confirm_typemap (session,
+                   nmap);
   GSC_CLIENTS_notify_clients_about_neighbour (peer,
                                               session->tmap,
                                               nmap);
@@ -125,13 +125,12 @@ GSC_SESSIONS_transmit (struct GSC_ClientActiveRequest *car,
 
 
 /**
- * Broadcast an updated typemap message to all neighbours.
- * Restarts the retransmissions until the typemaps are confirmed.
- *
- * @param msg message to transmit
+ * Broadcast our updated typemap to all neighbours, as a delta
+ * to those that support it.  Restarts the retransmissions until
+ * the typemaps are confirmed.
  */
 void
-GSC_SESSIONS_broadcast_typemap (const struct GNUNET_MessageHeader *msg);
+GSC_SESSIONS_broadcast_typemap (void);
 
 
 /**
@@ -155,6 +154,18 @@ GSC_SESSIONS_set_typemap (const struct GNUNET_PeerIdentity *peer,
                           const struct GNUNET_MessageHeader *msg);
 
 
+/**
+ * We have received a typemap delta from a peer, update ours.
+ * Notifies clients about the session.
+ *
+ * @param peer peer this is about
+ * @param msg typemap delta message
+ */
+void
+GSC_SESSIONS_update_typemap (const struct GNUNET_PeerIdentity *peer,
+                             const struct GNUNET_MessageHeader *msg);
+
+
 /**
  * The given peer send a message of the specified type.  Make sure the
  * respective bit is set in its type-map and that clients are notified
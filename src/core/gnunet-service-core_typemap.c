@@ -32,6 +32,64 @@
 #include <zlib.h>
 
 
+/**
+ * How many of our past type map versions do we remember, so that
+ * peers that confirmed one of them can be sent a delta?
+ */
+#define TYPEMAP_HISTORY 8
+
+/**
+ * Maximum number of type changes we put into a single delta; if
+ * more types changed, we send the full (compressed) map instead.
+ */
+#define MAX_DELTA_TYPES 256
+
+/**
+ * How long do we wait before announcing a change to our type map?
+ * Changes within this window (i.e. a client that disconnects and
+ * reconnects) are coalesced into one update, or none at all if the
+ * map ends up unchanged.
+ */
+#define TYPEMAP_BROADCAST_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Message describing the difference between two versions of
+ * the sender's type map.
+ */
+struct TypeMapDeltaMessage
+{
+
+  /**
+   * Header with type #GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Version of the sender's type map after applying the delta.
+   */
+  uint32_t version GNUNET_PACKED;
+
+  /**
+   * Hash of the type map the receiver must have for the delta
+   * to apply.
+   */
+  struct GNUNET_HashCode base_hash;
+
+  /**
+   * Hash of the type map after applying the delta.
+   */
+  struct GNUNET_HashCode tm_hash;
+
+  /* followed by the message types (in NBO) whose bit toggled */
+
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * A type map describing which messages a given neighbour is able
  * to process.
@@ -51,6 +109,44 @@ static struct GSC_TypeMap my_type_map;
  */
 static uint8_t map_counters[UINT16_MAX + 1];
 
+/**
+ * A version of our type map that was announced to our peers.
+ */
+struct TypeMapVersion
+{
+  /**
+   * The map as it was announced.
+   */
+  struct GSC_TypeMap map;
+
+  /**
+   * Hash of @e map.
+   */
+  struct GNUNET_HashCode hash;
+
+  /**
+   * Version number of @e map.
+   */
+  uint32_t version;
+};
+
+/**
+ * Recently announced versions of our type map, indexed by
+ * version modulo #TYPEMAP_HISTORY.
+ */
+static struct TypeMapVersion history[TYPEMAP_HISTORY];
+
+/**
+ * Version number of the last type map we announced.
+ */
+static uint32_t my_tm_version;
+
+/**
+ * Task that announces changes to our type map, NULL if
+ * no announcement is pending.
+ */
+static struct GNUNET_SCHEDULER_Task *broadcast_task;
+
 /**
  * Current hash of our (uncompressed) type map.
  * Lazily computed when needed.
@@ -198,19 +294,214 @@ GSC_TYPEMAP_get_from_message (const struct GNUNET_MessageHeader *msg)
 
 
 /**
- * Send my type map to all connected peers (it got changed).
+ * Find the version of our type map with the given hash.
+ *
+ * @param hc hash of a type map (i.e. from a confirmation)
+ * @param[out] version set to the version of the map with hash @a hc
+ * @return #GNUNET_YES if @a hc is one of our recently announced
+ *         type maps, #GNUNET_NO if not
+ */
+int
+GSC_TYPEMAP_get_version (const struct GNUNET_HashCode *hc,
+                         uint32_t *version)
+{
+  uint32_t v;
+  unsigned int i;
+
+  /* check the newest versions first */
+  for (i = 0; i < TYPEMAP_HISTORY; i++)
+  {
+    v = my_tm_version - i;
+    if (history[v % TYPEMAP_HISTORY].version != v)
+      break;
+    if (0 == memcmp (hc,
+                     &history[v % TYPEMAP_HISTORY].hash,
+                     sizeof (struct GNUNET_HashCode)))
+    {
+      *version = v;
+      return GNUNET_YES;
+    }
+    if (0 == v)
+      break;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Compute a message telling a peer that has version @a base_version
+ * of our type map how to obtain the latest version we announced.
+ *
+ * @param base_version version of our type map the peer confirmed
+ * @return delta message, NULL if @a base_version is no longer
+ *         known or too many types changed (send the full map instead)
+ */
+struct GNUNET_MessageHeader *
+GSC_TYPEMAP_compute_delta_message (uint32_t base_version)
+{
+  const struct TypeMapVersion *base;
+  const struct TypeMapVersion *cur;
+  struct TypeMapDeltaMessage *dm;
+  uint16_t types[MAX_DELTA_TYPES];
+  uint16_t *dtypes;
+  unsigned int ntypes;
+  unsigned int i;
+  unsigned int j;
+  uint32_t diff;
+
+  if (my_tm_version - base_version >= TYPEMAP_HISTORY)
+    return NULL;
+  base = &history[base_version % TYPEMAP_HISTORY];
+  cur = &history[my_tm_version % TYPEMAP_HISTORY];
+  if (base->version != base_version)
+    return NULL;
+  ntypes = 0;
+  for (i = 0; i < (UINT16_MAX + 1) / 32; i++)
+  {
+    diff = base->map.bits[i] ^ cur->map.bits[i];
+    if (0 == diff)
+      continue;
+    for (j = 0; j < 32; j++)
+    {
+      if (0 == (diff & (1 << j)))
+        continue;
+      if (MAX_DELTA_TYPES == ntypes)
+        return NULL;
+      types[ntypes++] = (uint16_t) (i * 32 + j);
+    }
+  }
+  dm = GNUNET_malloc (sizeof (struct TypeMapDeltaMessage) +
+                      ntypes * sizeof (uint16_t));
+  dm->header.size = htons (sizeof (struct TypeMapDeltaMessage) +
+                           ntypes * sizeof (uint16_t));
+  dm->header.type = htons (GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP);
+  dm->version = htonl (my_tm_version);
+  dm->base_hash = base->hash;
+  dm->tm_hash = cur->hash;
+  dtypes = (uint16_t *) &dm[1];
+  for (i = 0; i < ntypes; i++)
+    dtypes[i] = htons (types[i]);
+  return &dm->header;
+}
+
+
+/**
+ * Apply a #GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP message to the
+ * type map we have for the sender.
+ *
+ * @param tmap current type map of the sender
+ * @param msg the delta message
+ * @param[out] version set to the sender's version of the resulting map
+ * @return updated type map (fresh copy), NULL if @a msg is malformed
+ *         or does not apply to @a tmap
+ */
+struct GSC_TypeMap *
+GSC_TYPEMAP_apply_delta (const struct GSC_TypeMap *tmap,
+                         const struct GNUNET_MessageHeader *msg,
+                         uint32_t *version)
+{
+  const struct TypeMapDeltaMessage *dm;
+  const uint16_t *dtypes;
+  struct GSC_TypeMap *ret;
+  struct GNUNET_HashCode hc;
+  uint16_t size;
+  uint16_t type;
+  unsigned int ntypes;
+  unsigned int i;
+
+  size = ntohs (msg->size);
+  if ( (size < sizeof (struct TypeMapDeltaMessage)) ||
+       (0 != (size - sizeof (struct TypeMapDeltaMessage)) % sizeof (uint16_t)) )
+  {
+    GNUNET_break_op (0);
+    return NULL;
+  }
+  GNUNET_STATISTICS_update (GSC_stats,
+                            gettext_noop ("# type map deltas received"),
+                            1, GNUNET_NO);
+  dm = (const struct TypeMapDeltaMessage *) msg;
+  ntypes = (size - sizeof (struct TypeMapDeltaMessage)) / sizeof (uint16_t);
+  dtypes = (const uint16_t *) &dm[1];
+  ret = GSC_TYPEMAP_create ();
+  if (NULL != tmap)
+    memcpy (ret, tmap, sizeof (struct GSC_TypeMap));
+  GSC_TYPEMAP_hash (ret, &hc);
+  if (0 != memcmp (&hc,
+                   &dm->base_hash,
+                   sizeof (struct GNUNET_HashCode)))
+  {
+    GNUNET_STATISTICS_update (GSC_stats,
+                              gettext_noop ("# type map deltas with unknown base received"),
+                              1, GNUNET_NO);
+    GSC_TYPEMAP_destroy (ret);
+    return NULL;
+  }
+  for (i = 0; i < ntypes; i++)
+  {
+    type = ntohs (dtypes[i]);
+    ret->bits[type / 32] ^= (1 << (type % 32));
+  }
+  GSC_TYPEMAP_hash (ret, &hc);
+  if (0 != memcmp (&hc,
+                   &dm->tm_hash,
+                   sizeof (struct GNUNET_HashCode)))
+  {
+    GNUNET_break_op (0);
+    GSC_TYPEMAP_destroy (ret);
+    return NULL;
+  }
+  *version = ntohl (dm->version);
+  return ret;
+}
+
+
+/**
+ * Announce the changes to my type map to all connected
+ * peers, unless the changes cancelled out.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
  */
 static void
-broadcast_my_type_map ()
+do_broadcast_my_type_map (void *cls,
+                          const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct GNUNET_MessageHeader *hdr;
+  struct TypeMapVersion *tv;
 
-  hdr = GSC_TYPEMAP_compute_type_map_message ();
+  broadcast_task = NULL;
+  if (GNUNET_YES ==
+      GSC_TYPEMAP_check_hash (&history[my_tm_version % TYPEMAP_HISTORY].hash))
+  {
+    /* back to the map we last announced, nothing to tell */
+    GNUNET_STATISTICS_update (GSC_stats,
+                              gettext_noop ("# type map updates coalesced"), 1,
+                              GNUNET_NO);
+    return;
+  }
+  my_tm_version++;
+  tv = &history[my_tm_version % TYPEMAP_HISTORY];
+  tv->map = my_type_map;
+  tv->hash = my_tm_hash;
+  tv->version = my_tm_version;
   GNUNET_STATISTICS_update (GSC_stats,
                             gettext_noop ("# updates to my type map"), 1,
                             GNUNET_NO);
-  GSC_SESSIONS_broadcast_typemap (hdr);
-  GNUNET_free (hdr);
+  GSC_SESSIONS_broadcast_typemap ();
+}
+
+
+/**
+ * Send my type map to all connected peers (it got changed).
+ * The announcement is delayed a bit to coalesce related changes.
+ */
+static void
+broadcast_my_type_map ()
+{
+  if (NULL != broadcast_task)
+    return;
+  broadcast_task = GNUNET_SCHEDULER_add_delayed (TYPEMAP_BROADCAST_DELAY,
+                                                 &do_broadcast_my_type_map,
+                                                 NULL);
 }
 
 
@@ -356,7 +647,9 @@ GSC_TYPEMAP_destroy (struct GSC_TypeMap *tmap)
 void
 GSC_TYPEMAP_init ()
 {
-  /* nothing to do */
+  /* version 0 is the empty map we start with */
+  GSC_TYPEMAP_hash (&history[0].map,
+                    &history[0].hash);
 }
 
 
@@ -366,7 +659,11 @@ GSC_TYPEMAP_init ()
 void
 GSC_TYPEMAP_done ()
 {
-  /* nothing to do */
+  if (NULL != broadcast_task)
+  {
+    GNUNET_SCHEDULER_cancel (broadcast_task);
+    broadcast_task = NULL;
+  }
 }
 
 /* end of gnunet-service-core_typemap.c */
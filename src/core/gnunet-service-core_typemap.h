@@ -99,6 +99,47 @@ struct GSC_TypeMap *
 GSC_TYPEMAP_get_from_message (const struct GNUNET_MessageHeader *msg);
 
 
+/**
+ * Find the version of our type map with the given hash.
+ *
+ * @param hc hash of a type map (i.e. from a confirmation)
+ * @param[out] version set to the version of the map with hash @a hc
+ * @return #GNUNET_YES if @a hc is one of our recently announced
+ *         type maps, #GNUNET_NO if not
+ */
+int
+GSC_TYPEMAP_get_version (const struct GNUNET_HashCode *hc,
+                         uint32_t *version);
+
+
+/**
+ * Compute a message telling a peer that has version @a base_version
+ * of our type map how to obtain the latest version we announced.
+ *
+ * @param base_version version of our type map the peer confirmed
+ * @return delta message, NULL if @a base_version is no longer
+ *         known or too many types changed (send the full map instead)
+ */
+struct GNUNET_MessageHeader *
+GSC_TYPEMAP_compute_delta_message (uint32_t base_version);
+
+
+/**
+ * Apply a #GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP message to the
+ * type map we have for the sender.
+ *
+ * @param tmap current type map of the sender
+ * @param msg the delta message
+ * @param[out] version set to the sender's version of the resulting map
+ * @return updated type map (fresh copy), NULL if @a msg is malformed
+ *         or does not apply to @a tmap
+ */
+struct GSC_TypeMap *
+GSC_TYPEMAP_apply_delta (const struct GSC_TypeMap *tmap,
+                         const struct GNUNET_MessageHeader *msg,
+                         uint32_t *version);
+
+
 /**
  * Test if any of the types from the types array is in the
  * given type map.
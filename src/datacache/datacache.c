@@ -410,4 +410,37 @@ GNUNET_DATACACHE_get_closest (struct GNUNET_DATACACHE_Handle *h,
 }
 
 
+/**
+ * Stream the entries of the datacache in the order of
+ * #GNUNET_DATACACHE_get_closest(), starting at @a key, until @a iter
+ * returns something other than #GNUNET_OK.
+ *
+ * @param h handle to the datacache
+ * @param key where in the keyspace to start the scan
+ * @param iter function to call on each entry
+ * @param iter_cls closure for @a iter
+ * @return the number of entries passed to @a iter
+ */
+unsigned int
+GNUNET_DATACACHE_scan (struct GNUNET_DATACACHE_Handle *h,
+                       const struct GNUNET_HashCode *key,
+                       GNUNET_DATACACHE_Iterator iter,
+                       void *iter_cls)
+{
+  GNUNET_STATISTICS_update (h->stats,
+                            gettext_noop ("# range scans started"),
+                            1,
+                            GNUNET_NO);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Processing range scan at `%s'\n",
+       GNUNET_h2s (key));
+  GNUNET_assert (NULL != iter);
+  return h->api->get_closest (h->api->cls,
+                              key,
+                              UINT_MAX,
+                              iter,
+                              iter_cls);
+}
+
+
 /* end of datacache.c */
@@ -31,6 +31,14 @@
 
 #define LOG_STRERROR_FILE(kind,op,fn) GNUNET_log_from_strerror_file (kind, "datacache-heap", op, fn)
 
+/**
+ * Maximum number of levels of the skip list ordering the values by
+ * key.  With a promotion probability of 1/4 this is plenty for any
+ * datacache that fits into memory.
+ */
+#define SKIP_LIST_MAX_LEVEL 16
+
+struct Value;
 
 
 /**
@@ -53,6 +61,17 @@ struct Plugin
    */
   struct GNUNET_CONTAINER_Heap *heap;
 
+  /**
+   * Heads of the skip list levels, ordering all values by key
+   * for #heap_plugin_get_closest().
+   */
+  struct Value *skip_head[SKIP_LIST_MAX_LEVEL];
+
+  /**
+   * Number of skip list levels currently in use.
+   */
+  unsigned int skip_levels;
+
 };
 
 
@@ -82,7 +101,13 @@ struct Value
   struct GNUNET_PeerIdentity *path_info;
 
   /**
-   * Payload (actual payload follows this struct)
+   * Successors in the skip list, one per level; the array
+   * follows this struct, the payload follows the array.
+   */
+  struct Value **next;
+
+  /**
+   * Payload (actual payload follows @e next)
    */
   size_t size;
 
@@ -91,6 +116,11 @@ struct Value
    */
   unsigned int path_info_len;
 
+  /**
+   * Number of entries in @e next.
+   */
+  unsigned int level;
+
   /**
    * Type of the block.
    */
@@ -102,6 +132,167 @@ struct Value
 #define OVERHEAD (sizeof (struct Value) + 64)
 
 
+/**
+ * Get the payload of a value.
+ *
+ * @param val the value
+ * @return pointer to the payload of @a val
+ */
+static const char *
+get_data (const struct Value *val)
+{
+  return (const char *) &val->next[val->level];
+}
+
+
+/**
+ * Compare a value against a position in the skip list.  Values are
+ * ordered by key, values with the same key by address.
+ *
+ * @param val value to compare
+ * @param key key of the position
+ * @param ptr address of the position, 0 for "before all values with @a key"
+ * @return #GNUNET_YES if @a val comes before the position
+ */
+static int
+skip_before (const struct Value *val,
+             const struct GNUNET_HashCode *key,
+             uintptr_t ptr)
+{
+  int cmp;
+
+  cmp = GNUNET_CRYPTO_hash_cmp (&val->key,
+                                key);
+  if (0 != cmp)
+    return (cmp < 0) ? GNUNET_YES : GNUNET_NO;
+  return ((uintptr_t) val < ptr) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Find the predecessors of a position in the skip list on each level.
+ *
+ * @param plugin our plugin
+ * @param key key of the position
+ * @param ptr address of the position, see #skip_before()
+ * @param[out] update set to the predecessor on each level, NULL for the head
+ */
+static void
+skip_find (struct Plugin *plugin,
+           const struct GNUNET_HashCode *key,
+           uintptr_t ptr,
+           struct Value *update[SKIP_LIST_MAX_LEVEL])
+{
+  struct Value *pos;
+  struct Value *next;
+  unsigned int l;
+
+  pos = NULL;
+  for (l = plugin->skip_levels; l > 0; l--)
+  {
+    next = (NULL == pos) ? plugin->skip_head[l - 1] : pos->next[l - 1];
+    while ( (NULL != next) &&
+            (GNUNET_YES == skip_before (next, key, ptr)) )
+    {
+      pos = next;
+      next = pos->next[l - 1];
+    }
+    update[l - 1] = pos;
+  }
+}
+
+
+/**
+ * Pick the number of levels for a new skip list entry.
+ *
+ * @return level between 1 and #SKIP_LIST_MAX_LEVEL
+ */
+static unsigned int
+skip_random_level ()
+{
+  uint32_t r;
+  unsigned int level;
+
+  r = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                UINT32_MAX);
+  level = 1;
+  while ( (0 == (r & 3)) &&
+          (level < SKIP_LIST_MAX_LEVEL) )
+  {
+    level++;
+    r >>= 2;
+  }
+  return level;
+}
+
+
+/**
+ * Link a new value into the skip list.
+ *
+ * @param plugin our plugin
+ * @param val value to insert, with @e level set
+ */
+static void
+skip_insert (struct Plugin *plugin,
+             struct Value *val)
+{
+  struct Value *update[SKIP_LIST_MAX_LEVEL];
+  unsigned int l;
+
+  skip_find (plugin, &val->key, (uintptr_t) val, update);
+  for (l = plugin->skip_levels; l < val->level; l++)
+    update[l] = NULL;
+  if (val->level > plugin->skip_levels)
+    plugin->skip_levels = val->level;
+  for (l = 0; l < val->level; l++)
+  {
+    if (NULL == update[l])
+    {
+      val->next[l] = plugin->skip_head[l];
+      plugin->skip_head[l] = val;
+    }
+    else
+    {
+      val->next[l] = update[l]->next[l];
+      update[l]->next[l] = val;
+    }
+  }
+}
+
+
+/**
+ * Unlink a value from the skip list.
+ *
+ * @param plugin our plugin
+ * @param val value to remove
+ */
+static void
+skip_remove (struct Plugin *plugin,
+             struct Value *val)
+{
+  struct Value *update[SKIP_LIST_MAX_LEVEL];
+  unsigned int l;
+
+  skip_find (plugin, &val->key, (uintptr_t) val, update);
+  for (l = 0; l < val->level; l++)
+  {
+    if (NULL == update[l])
+    {
+      GNUNET_assert (plugin->skip_head[l] == val);
+      plugin->skip_head[l] = val->next[l];
+    }
+    else
+    {
+      GNUNET_assert (update[l]->next[l] == val);
+      update[l]->next[l] = val->next[l];
+    }
+  }
+  while ( (plugin->skip_levels > 0) &&
+          (NULL == plugin->skip_head[plugin->skip_levels - 1]) )
+    plugin->skip_levels--;
+}
+
+
 /**
  * Closure for #put_cb().
  */
@@ -168,7 +359,7 @@ put_cb (void *cls,
 
   if ( (val->size == put_ctx->size) &&
        (val->type == put_ctx->type) &&
-       (0 == memcmp (&val[1], put_ctx->data, put_ctx->size)) )
+       (0 == memcmp (get_data (val), put_ctx->data, put_ctx->size)) )
   {
     put_ctx->found = GNUNET_YES;
     val->discard_time = GNUNET_TIME_absolute_max (val->discard_time,
@@ -221,6 +412,7 @@ heap_plugin_put (void *cls,
   struct Plugin *plugin = cls;
   struct Value *val;
   struct PutContext put_ctx;
+  unsigned int level;
 
   put_ctx.found = GNUNET_NO;
   put_ctx.heap = plugin->heap;
@@ -236,8 +428,13 @@ heap_plugin_put (void *cls,
 					      &put_ctx);
   if (GNUNET_YES == put_ctx.found)
     return 0;
-  val = GNUNET_malloc (sizeof (struct Value) + size);
-  memcpy (&val[1], data, size);
+  level = skip_random_level ();
+  val = GNUNET_malloc (sizeof (struct Value) +
+                       level * sizeof (struct Value *) +
+                       size);
+  val->next = (struct Value **) &val[1];
+  val->level = level;
+  memcpy (&val->next[level], data, size);
   val->key = *key;
   val->type = type;
   val->discard_time = discard_time;
@@ -254,6 +451,7 @@ heap_plugin_put (void *cls,
   val->hn = GNUNET_CONTAINER_heap_insert (plugin->heap,
 					  val,
 					  val->discard_time.abs_value_us);
+  skip_insert (plugin, val);
   return size + OVERHEAD;
 }
 
@@ -311,7 +509,7 @@ get_cb (void *cls,
     ret = get_ctx->iter (get_ctx->iter_cls,
 			 key,
 			 val->size,
-			 (const char *) &val[1],
+			 get_data (val),
 			 val->type,
                          val->discard_time,
 			 val->path_info_len,
@@ -376,6 +574,7 @@ heap_plugin_del (void *cls)
 		 GNUNET_CONTAINER_multihashmap_remove (plugin->map,
 						       &val->key,
 						       val));
+  skip_remove (plugin, val);
   plugin->env->delete_notify (plugin->env->cls,
 			      &val->key,
 			      val->size + OVERHEAD);
@@ -432,8 +631,52 @@ heap_plugin_get_closest (void *cls,
                          GNUNET_DATACACHE_Iterator iter,
                          void *iter_cls)
 {
-  GNUNET_break (0); // not implemented!
-  return 0;
+  struct Plugin *plugin = cls;
+  struct Value *update[SKIP_LIST_MAX_LEVEL];
+  struct Value *pos;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int cnt;
+  int wrapped;
+
+  now = GNUNET_TIME_absolute_get ();
+  skip_find (plugin, key, 0, update);
+  pos = ( (0 == plugin->skip_levels) ||
+          (NULL == update[0]) )
+    ? plugin->skip_head[0]
+    : update[0]->next[0];
+  wrapped = GNUNET_NO;
+  cnt = 0;
+  while (cnt < num_results)
+  {
+    if (NULL == pos)
+    {
+      /* continue with the smallest keys, but only once */
+      if (GNUNET_YES == wrapped)
+        break;
+      wrapped = GNUNET_YES;
+      pos = plugin->skip_head[0];
+      continue;
+    }
+    if ( (GNUNET_YES == wrapped) &&
+         (GNUNET_NO == skip_before (pos, key, 0)) )
+      break;
+    if (pos->discard_time.abs_value_us >= now.abs_value_us)
+    {
+      cnt++;
+      if ( (NULL != iter) &&
+           (GNUNET_OK != iter (iter_cls,
+                               &pos->key,
+                               pos->size,
+                               get_data (pos),
+                               pos->type,
+                               pos->discard_time,
+                               pos->path_info_len,
+                               pos->path_info)) )
+        break;
+    }
+    pos = pos->next[0];
+  }
+  return cnt;
 }
 
 
@@ -532,7 +532,8 @@ postgres_plugin_get_closest (void *cls,
                              void *iter_cls)
 {
   struct Plugin *plugin = cls;
-  uint32_t nbo_limit = htonl (num_results);
+  /* LIMIT is a signed integer, clamp "unlimited" range scans */
+  uint32_t nbo_limit = htonl (GNUNET_MIN (num_results, INT32_MAX));
   const char *paramValues[] = {
     (const char *) key,
     (const char *) &nbo_limit,
@@ -613,7 +614,7 @@ postgres_plugin_get_closest (void *cls,
 	 "Found result of size %u bytes and type %u in database\n",
 	 (unsigned int) size,
          (unsigned int) type);
-    if (GNUNET_SYSERR ==
+    if (GNUNET_OK !=
         iter (iter_cls,
               key,
               size,
@@ -624,9 +625,9 @@ postgres_plugin_get_closest (void *cls,
 	      path))
     {
       LOG (GNUNET_ERROR_TYPE_DEBUG,
-	   "Ending iteration (client error)\n");
+	   "Ending iteration (client request)\n");
       PQclear (res);
-      return cnt;
+      return i + 1;
     }
   }
   PQclear (res);
@@ -0,0 +1,970 @@
+/*
+     This file is part of GNUnet
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file datacache/plugin_datacache_shard.c
+ * @brief sharded in-memory implementation of a database backend for
+ *        the datacache
+ * @author Christian Grothoff
+ *
+ * The key space is split into shards by the most significant bits of
+ * the key.  Each shard stores its records back-to-back in a ring
+ * buffer (the "arena"), which grows on demand and shrinks again as
+ * records are evicted, so that the memory used follows the bytes
+ * stored rather than being reserved upfront.  Records are found using a per-shard index of arena
+ * offsets sorted by key; as shards cover consecutive ranges of the
+ * key space, walking the shards in order visits all keys in order,
+ * which gives us #shard_plugin_get_closest().
+ *
+ * As the arena is a log, records are evicted in the order they were
+ * stored, except that expired records at the head of a shard go
+ * first.  The size reported to the datacache is the exact number of
+ * bytes a record occupies in the arena.
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_datacache_plugin.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "datacache-shard", __VA_ARGS__)
+
+/**
+ * Default number of shards.
+ */
+#define DEFAULT_SHARDS 16
+
+/**
+ * Maximum number of shards.
+ */
+#define MAX_SHARDS 256
+
+/**
+ * Initial size of the arena of a shard.
+ */
+#define INITIAL_ARENA_SIZE (64 * 1024)
+
+/**
+ * Round @a n up to a multiple of 8, the alignment of records in the
+ * arena.
+ */
+#define ALIGN_RECORD(n) (((n) + 7) & ~((size_t) 7))
+
+
+/**
+ * Header of a record in the arena.  Followed by the payload and the
+ * path information.
+ */
+struct Record
+{
+  /**
+   * Key for the entry.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Expiration time.
+   */
+  struct GNUNET_TIME_Absolute discard_time;
+
+  /**
+   * When was this record stored, to find the oldest record.
+   */
+  uint64_t seq;
+
+  /**
+   * Number of bytes the record occupies in the arena, including
+   * this header.
+   */
+  uint32_t total;
+
+  /**
+   * Number of bytes in the payload.
+   */
+  uint32_t size;
+
+  /**
+   * Number of entries in the path information.
+   */
+  uint32_t path_info_len;
+
+  /**
+   * Type of the block.
+   */
+  uint32_t type;
+};
+
+
+/**
+ * A shard of the datacache.
+ */
+struct Shard
+{
+  /**
+   * Storage for the records, NULL until the first record arrives.
+   */
+  char *arena;
+
+  /**
+   * Offsets of the records in the @e arena, sorted by key.
+   */
+  uint32_t *index;
+
+  /**
+   * Number of bytes allocated for @e arena.
+   */
+  size_t capacity;
+
+  /**
+   * Offset of the oldest record.
+   */
+  size_t head;
+
+  /**
+   * Offset where the next record will be stored.
+   */
+  size_t tail;
+
+  /**
+   * If @e wrapped, the end of the records before the ring wrapped
+   * around to the start of the @e arena.
+   */
+  size_t wrap_end;
+
+  /**
+   * Number of bytes used by records (exactly what we report to the
+   * datacache).
+   */
+  size_t used;
+
+  /**
+   * Number of entries in @e index (the number of records).
+   */
+  unsigned int index_len;
+
+  /**
+   * Number of entries allocated for @e index.
+   */
+  unsigned int index_size;
+
+  /**
+   * #GNUNET_YES if the records wrapped around the end of the
+   * @e arena (the ring is [head, wrap_end) followed by [0, tail)).
+   */
+  int wrapped;
+};
+
+
+/**
+ * Context for all functions in this plugin.
+ */
+struct Plugin
+{
+  /**
+   * Our execution environment.
+   */
+  struct GNUNET_DATACACHE_PluginEnvironment *env;
+
+  /**
+   * Our shards, ordered by the key ranges they cover.
+   */
+  struct Shard *shards;
+
+  /**
+   * Maximum size of the arena of a shard.
+   */
+  size_t max_capacity;
+
+  /**
+   * Sequence number for the next record stored.
+   */
+  uint64_t next_seq;
+
+  /**
+   * Number of entries in @e shards (a power of two).
+   */
+  unsigned int num_shards;
+
+  /**
+   * Number of key bits used to select the shard.
+   */
+  unsigned int shard_bits;
+
+};
+
+
+/**
+ * Get the record at the given offset of a shard's arena.
+ *
+ * @param shard the shard
+ * @param off offset of the record
+ * @return the record
+ */
+static struct Record *
+get_record (struct Shard *shard,
+            size_t off)
+{
+  return (struct Record *) &shard->arena[off];
+}
+
+
+/**
+ * Get the path information of a record (it follows the payload).
+ *
+ * @param rec the record
+ * @return the path information
+ */
+static struct GNUNET_PeerIdentity *
+get_path (struct Record *rec)
+{
+  return (struct GNUNET_PeerIdentity *) (((char *) &rec[1]) + rec->size);
+}
+
+
+/**
+ * Find the shard responsible for a key.  The shard is selected by
+ * the bits of the key that are most significant for
+ * GNUNET_CRYPTO_hash_cmp().
+ *
+ * @param plugin the plugin
+ * @param key the key
+ * @return index of the shard
+ */
+static unsigned int
+get_shard (struct Plugin *plugin,
+           const struct GNUNET_HashCode *key)
+{
+  if (0 == plugin->shard_bits)
+    return 0;
+  return key->bits[(sizeof (struct GNUNET_HashCode) / sizeof (uint32_t)) - 1]
+    >> (32 - plugin->shard_bits);
+}
+
+
+/**
+ * Find the first position in the index of a shard whose key is not
+ * smaller than @a key.
+ *
+ * @param shard the shard
+ * @param key the key
+ * @return position in the index
+ */
+static unsigned int
+index_lower_bound (struct Shard *shard,
+                   const struct GNUNET_HashCode *key)
+{
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+
+  lo = 0;
+  hi = shard->index_len;
+  while (lo < hi)
+  {
+    mid = lo + (hi - lo) / 2;
+    if (GNUNET_CRYPTO_hash_cmp (&get_record (shard, shard->index[mid])->key,
+                                key) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+
+/**
+ * Find the position of a record in the index of a shard.
+ *
+ * @param shard the shard
+ * @param key key of the record
+ * @param off offset of the record in the arena
+ * @return position in the index
+ */
+static unsigned int
+index_find (struct Shard *shard,
+            const struct GNUNET_HashCode *key,
+            size_t off)
+{
+  unsigned int pos;
+
+  for (pos = index_lower_bound (shard, key); pos < shard->index_len; pos++)
+    if (off == shard->index[pos])
+      return pos;
+  GNUNET_assert (0);
+  return 0;
+}
+
+
+/**
+ * Add a record to the index of a shard, after the records with the
+ * same key.
+ *
+ * @param shard the shard
+ * @param off offset of the record in the arena
+ */
+static void
+index_insert (struct Shard *shard,
+              size_t off)
+{
+  const struct GNUNET_HashCode *key = &get_record (shard, off)->key;
+  unsigned int pos;
+
+  pos = index_lower_bound (shard, key);
+  while ( (pos < shard->index_len) &&
+          (0 == GNUNET_CRYPTO_hash_cmp (&get_record (shard, shard->index[pos])->key,
+                                        key)) )
+    pos++;
+  if (shard->index_len == shard->index_size)
+    GNUNET_array_grow (shard->index,
+                       shard->index_size,
+                       GNUNET_MAX (16, shard->index_size * 2));
+  memmove (&shard->index[pos + 1],
+           &shard->index[pos],
+           (shard->index_len - pos) * sizeof (uint32_t));
+  shard->index[pos] = (uint32_t) off;
+  shard->index_len++;
+}
+
+
+/**
+ * Remove a record from the index of a shard.
+ *
+ * @param shard the shard
+ * @param off offset of the record in the arena
+ */
+static void
+index_remove (struct Shard *shard,
+              size_t off)
+{
+  unsigned int pos;
+
+  pos = index_find (shard, &get_record (shard, off)->key, off);
+  memmove (&shard->index[pos],
+           &shard->index[pos + 1],
+           (shard->index_len - pos - 1) * sizeof (uint32_t));
+  shard->index_len--;
+}
+
+
+/**
+ * Reserve space for a record in the arena of a shard, without
+ * evicting anything.
+ *
+ * @param shard the shard
+ * @param total number of bytes needed
+ * @param[out] off set to the offset of the space
+ * @return #GNUNET_OK on success, #GNUNET_NO if there is no room
+ */
+static int
+arena_alloc (struct Shard *shard,
+             size_t total,
+             size_t *off)
+{
+  if (GNUNET_NO == shard->wrapped)
+  {
+    if (shard->head == shard->tail)
+    {
+      /* empty, start over */
+      shard->head = 0;
+      shard->tail = 0;
+    }
+    if (shard->capacity - shard->tail >= total)
+    {
+      *off = shard->tail;
+      shard->tail += total;
+      return GNUNET_OK;
+    }
+    if (shard->head >= total)
+    {
+      shard->wrap_end = shard->tail;
+      shard->wrapped = GNUNET_YES;
+      *off = 0;
+      shard->tail = total;
+      return GNUNET_OK;
+    }
+    return GNUNET_NO;
+  }
+  if (shard->head - shard->tail >= total)
+  {
+    *off = shard->tail;
+    shard->tail += total;
+    return GNUNET_OK;
+  }
+  return GNUNET_NO;
+}
+
+
+/**
+ * Release the space of the oldest record of a shard in the arena.
+ * The record itself remains readable until the space is reused.
+ *
+ * @param shard the shard
+ * @return offset of the record that was released
+ */
+static size_t
+arena_pop (struct Shard *shard)
+{
+  size_t off;
+
+  off = shard->head;
+  shard->head += get_record (shard, off)->total;
+  if ( (GNUNET_YES == shard->wrapped) &&
+       (shard->head == shard->wrap_end) )
+  {
+    shard->head = 0;
+    shard->wrapped = GNUNET_NO;
+  }
+  return off;
+}
+
+
+/**
+ * Move the records of a shard to a new arena of the given capacity,
+ * to the start of it in ring order.
+ *
+ * @param shard the shard
+ * @param capacity new capacity, at least the bytes used by the records
+ * @return #GNUNET_OK on success, #GNUNET_NO if we are out of memory
+ */
+static int
+arena_resize (struct Shard *shard,
+              size_t capacity)
+{
+  char *arena;
+  uint32_t *index;
+  size_t off;
+  size_t noff;
+  unsigned int cnt;
+  unsigned int pos;
+  int wrapped;
+  struct Record *rec;
+
+  GNUNET_assert (capacity >= shard->used);
+  if (0 == shard->index_len)
+  {
+    /* nothing to move, allocate lazily */
+    GNUNET_free_non_null (shard->arena);
+    shard->arena = NULL;
+    shard->capacity = 0;
+    shard->head = 0;
+    shard->tail = 0;
+    shard->wrapped = GNUNET_NO;
+    if (0 == capacity)
+      return GNUNET_OK;
+  }
+  arena = GNUNET_malloc_large (capacity);
+  if (NULL == arena)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Failed to allocate %llu bytes for the datacache\n"),
+         (unsigned long long) capacity);
+    return GNUNET_NO;
+  }
+  /* the old index must stay intact while we look up the records */
+  index = GNUNET_new_array (GNUNET_MAX (1, shard->index_size),
+                            uint32_t);
+  off = shard->head;
+  noff = 0;
+  wrapped = shard->wrapped;
+  for (cnt = 0; cnt < shard->index_len; cnt++)
+  {
+    if ( (GNUNET_YES == wrapped) &&
+         (off == shard->wrap_end) )
+    {
+      off = 0;
+      wrapped = GNUNET_NO;
+    }
+    rec = get_record (shard, off);
+    pos = index_find (shard, &rec->key, off);
+    memcpy (&arena[noff], rec, rec->total);
+    index[pos] = (uint32_t) noff;
+    noff += rec->total;
+    off += rec->total;
+  }
+  if (0 != shard->index_len)
+    memcpy (shard->index,
+            index,
+            shard->index_len * sizeof (uint32_t));
+  GNUNET_free (index);
+  GNUNET_free_non_null (shard->arena);
+  shard->arena = arena;
+  shard->capacity = capacity;
+  shard->head = 0;
+  shard->tail = noff;
+  shard->wrapped = GNUNET_NO;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Grow the arena of a shard so that it has at least @a total bytes of
+ * contiguous free space, without exceeding the maximum capacity.
+ *
+ * @param plugin the plugin
+ * @param shard the shard
+ * @param total number of bytes needed
+ * @return #GNUNET_OK on success, #GNUNET_NO if the shard is at its
+ *         maximum capacity already
+ */
+static int
+arena_grow (struct Plugin *plugin,
+            struct Shard *shard,
+            size_t total)
+{
+  size_t capacity;
+
+  if (shard->capacity == plugin->max_capacity)
+    return GNUNET_NO;
+  capacity = GNUNET_MAX (INITIAL_ARENA_SIZE,
+                         GNUNET_MAX (2 * shard->capacity,
+                                     shard->used + total));
+  capacity = GNUNET_MIN (capacity, plugin->max_capacity);
+  return arena_resize (shard, capacity);
+}
+
+
+/**
+ * Evict the oldest record of a shard.
+ *
+ * @param plugin the plugin
+ * @param shard the shard, must not be empty
+ */
+static void
+shard_evict (struct Plugin *plugin,
+             struct Shard *shard)
+{
+  struct Record *rec;
+  size_t off;
+
+  GNUNET_assert (0 != shard->index_len);
+  off = arena_pop (shard);
+  rec = get_record (shard, off);
+  index_remove (shard, off);
+  shard->used -= rec->total;
+  plugin->env->delete_notify (plugin->env->cls,
+                              &rec->key,
+                              rec->total);
+  /* give memory back once the shard is mostly empty */
+  if (0 == shard->index_len)
+    (void) arena_resize (shard, 0);
+  else if ( (shard->capacity > INITIAL_ARENA_SIZE) &&
+            (shard->used < shard->capacity / 4) )
+    (void) arena_resize (shard,
+                         GNUNET_MAX (INITIAL_ARENA_SIZE,
+                                     shard->capacity / 2));
+}
+
+
+/**
+ * Store an item in the datastore.
+ *
+ * @param cls closure (our `struct Plugin`)
+ * @param key key to store data under
+ * @param size number of bytes in @a data
+ * @param data data to store
+ * @param type type of the value
+ * @param discard_time when to discard the value in any case
+ * @param path_info_len number of entries in @a path_info
+ * @param path_info a path through the network
+ * @return 0 if duplicate, -1 on error, number of bytes used otherwise
+ */
+static ssize_t
+shard_plugin_put (void *cls,
+                  const struct GNUNET_HashCode *key,
+                  size_t size,
+                  const char *data,
+                  enum GNUNET_BLOCK_Type type,
+                  struct GNUNET_TIME_Absolute discard_time,
+                  unsigned int path_info_len,
+                  const struct GNUNET_PeerIdentity *path_info)
+{
+  struct Plugin *plugin = cls;
+  struct Shard *shard;
+  struct Record *rec;
+  size_t total;
+  size_t off;
+  unsigned int pos;
+
+  shard = &plugin->shards[get_shard (plugin, key)];
+  for (pos = index_lower_bound (shard, key); pos < shard->index_len; pos++)
+  {
+    rec = get_record (shard, shard->index[pos]);
+    if (0 != GNUNET_CRYPTO_hash_cmp (&rec->key, key))
+      break;
+    if ( (rec->size != size) ||
+         (rec->type != type) ||
+         (0 != memcmp (&rec[1], data, size)) )
+      continue;
+    rec->discard_time = GNUNET_TIME_absolute_max (rec->discard_time,
+                                                  discard_time);
+    /* replace old path with new path, if it fits */
+    if (sizeof (struct Record) + size
+        + path_info_len * sizeof (struct GNUNET_PeerIdentity) <= rec->total)
+    {
+      memcpy (get_path (rec),
+              path_info,
+              path_info_len * sizeof (struct GNUNET_PeerIdentity));
+      rec->path_info_len = path_info_len;
+    }
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Got same value for key %s and type %d (size %u)\n",
+         GNUNET_h2s (key),
+         type,
+         (unsigned int) size);
+    return 0;
+  }
+  total = ALIGN_RECORD (sizeof (struct Record) + size
+                        + path_info_len * sizeof (struct GNUNET_PeerIdentity));
+  if (total > plugin->max_capacity)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Value of %u bytes is too large for the datacache\n"),
+         (unsigned int) size);
+    return -1;
+  }
+  while (GNUNET_OK != arena_alloc (shard, total, &off))
+  {
+    if (GNUNET_OK == arena_grow (plugin, shard, total))
+      continue;
+    shard_evict (plugin, shard);
+  }
+  rec = get_record (shard, off);
+  rec->key = *key;
+  rec->discard_time = discard_time;
+  rec->seq = plugin->next_seq++;
+  rec->total = (uint32_t) total;
+  rec->size = (uint32_t) size;
+  rec->path_info_len = path_info_len;
+  rec->type = type;
+  memcpy (&rec[1], data, size);
+  memcpy (get_path (rec),
+          path_info,
+          path_info_len * sizeof (struct GNUNET_PeerIdentity));
+  index_insert (shard, off);
+  shard->used += total;
+  return total;
+}
+
+
+/**
+ * Pass a record to an iterator.
+ *
+ * @param rec the record
+ * @param iter maybe NULL (to just count)
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK to continue to iterate, #GNUNET_NO to stop
+ */
+static int
+call_iterator (struct Record *rec,
+               GNUNET_DATACACHE_Iterator iter,
+               void *iter_cls)
+{
+  if (NULL == iter)
+    return GNUNET_OK;
+  return iter (iter_cls,
+               &rec->key,
+               rec->size,
+               (const char *) &rec[1],
+               rec->type,
+               rec->discard_time,
+               rec->path_info_len,
+               get_path (rec));
+}
+
+
+/**
+ * Iterate over the results for a particular key
+ * in the datastore.
+ *
+ * @param cls closure (our `struct Plugin`)
+ * @param key
+ * @param type entries of which type are relevant?
+ * @param iter maybe NULL (to just count)
+ * @param iter_cls closure for @a iter
+ * @return the number of results found
+ */
+static unsigned int
+shard_plugin_get (void *cls,
+                  const struct GNUNET_HashCode *key,
+                  enum GNUNET_BLOCK_Type type,
+                  GNUNET_DATACACHE_Iterator iter,
+                  void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Shard *shard;
+  struct Record *rec;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int pos;
+  unsigned int cnt;
+
+  shard = &plugin->shards[get_shard (plugin, key)];
+  now = GNUNET_TIME_absolute_get ();
+  cnt = 0;
+  for (pos = index_lower_bound (shard, key); pos < shard->index_len; pos++)
+  {
+    rec = get_record (shard, shard->index[pos]);
+    if (0 != GNUNET_CRYPTO_hash_cmp (&rec->key, key))
+      break;
+    if ( (type != rec->type) &&
+         (GNUNET_BLOCK_TYPE_ANY != type) )
+      continue;
+    if (rec->discard_time.abs_value_us < now.abs_value_us)
+      continue;
+    cnt++;
+    if (GNUNET_OK != call_iterator (rec, iter, iter_cls))
+      break;
+  }
+  return cnt;
+}
+
+
+/**
+ * Delete the entry with the lowest expiration value
+ * from the datacache right now.  We evict an expired record if there
+ * is one at the head of a shard, otherwise the oldest record.
+ *
+ * @param cls closure (our `struct Plugin`)
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+shard_plugin_del (void *cls)
+{
+  struct Plugin *plugin = cls;
+  struct Shard *shard;
+  struct Shard *victim;
+  struct Record *rec;
+  struct Record *oldest;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int i;
+
+  now = GNUNET_TIME_absolute_get ();
+  victim = NULL;
+  oldest = NULL;
+  for (i = 0; i < plugin->num_shards; i++)
+  {
+    shard = &plugin->shards[i];
+    if (0 == shard->index_len)
+      continue;
+    rec = get_record (shard, shard->head);
+    if (rec->discard_time.abs_value_us < now.abs_value_us)
+    {
+      victim = shard;
+      break;
+    }
+    if ( (NULL == oldest) ||
+         (rec->seq < oldest->seq) )
+    {
+      oldest = rec;
+      victim = shard;
+    }
+  }
+  if (NULL == victim)
+    return GNUNET_SYSERR;
+  shard_evict (plugin, victim);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Return a random value from the datastore.
+ *
+ * @param cls closure (our `struct Plugin`)
+ * @param iter maybe NULL (to just count)
+ * @param iter_cls closure for @a iter
+ * @return the number of results found
+ */
+static unsigned int
+shard_plugin_get_random (void *cls,
+                         GNUNET_DATACACHE_Iterator iter,
+                         void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Shard *shard;
+  unsigned int total;
+  unsigned int off;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < plugin->num_shards; i++)
+    total += plugin->shards[i].index_len;
+  if (0 == total)
+    return 0;
+  off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                  total);
+  for (i = 0; off >= plugin->shards[i].index_len; i++)
+    off -= plugin->shards[i].index_len;
+  shard = &plugin->shards[i];
+  (void) call_iterator (get_record (shard, shard->index[off]),
+                        iter,
+                        iter_cls);
+  return 1;
+}
+
+
+/**
+ * Iterate over the results that are "close" to a particular key in
+ * the datacache.  "close" is defined as numerically larger than @a
+ * key (when interpreted as a circular address space), with small
+ * distance.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param key area of the keyspace to look into
+ * @param num_results number of results that should be returned to @a iter
+ * @param iter maybe NULL (to just count)
+ * @param iter_cls closure for @a iter
+ * @return the number of results found
+ */
+static unsigned int
+shard_plugin_get_closest (void *cls,
+                          const struct GNUNET_HashCode *key,
+                          unsigned int num_results,
+                          GNUNET_DATACACHE_Iterator iter,
+                          void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Shard *shard;
+  struct Record *rec;
+  struct GNUNET_TIME_Absolute now;
+  unsigned int start;
+  unsigned int pos;
+  unsigned int cnt;
+  unsigned int i;
+
+  now = GNUNET_TIME_absolute_get ();
+  start = get_shard (plugin, key);
+  cnt = 0;
+  /* visit the shards in key order, wrapping around; the first one
+     is visited twice to see the keys smaller than @a key last */
+  for (i = 0; i <= plugin->num_shards; i++)
+  {
+    shard = &plugin->shards[(start + i) % plugin->num_shards];
+    pos = (0 == i) ? index_lower_bound (shard, key) : 0;
+    for (; pos < shard->index_len; pos++)
+    {
+      rec = get_record (shard, shard->index[pos]);
+      if ( (plugin->num_shards == i) &&
+           (GNUNET_CRYPTO_hash_cmp (&rec->key, key) >= 0) )
+        break;
+      if (rec->discard_time.abs_value_us < now.abs_value_us)
+        continue;
+      if (cnt == num_results)
+        return cnt;
+      cnt++;
+      if (GNUNET_OK != call_iterator (rec, iter, iter_cls))
+        return cnt;
+    }
+  }
+  return cnt;
+}
+
+
+/**
+ * Entry point for the plugin.
+ *
+ * @param cls closure (the `struct GNUNET_DATACACHE_PluginEnvironmnet`)
+ * @return the plugin's closure (our `struct Plugin`)
+ */
+void *
+libgnunet_plugin_datacache_shard_init (void *cls)
+{
+  struct GNUNET_DATACACHE_PluginEnvironment *env = cls;
+  struct GNUNET_DATACACHE_PluginFunctions *api;
+  struct Plugin *plugin;
+  unsigned long long num_shards;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (env->cfg,
+                                             env->section,
+                                             "SHARDS",
+                                             &num_shards))
+    num_shards = DEFAULT_SHARDS;
+  if ( (0 == num_shards) ||
+       (num_shards > MAX_SHARDS) ||
+       (0 != (num_shards & (num_shards - 1))) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               env->section,
+                               "SHARDS",
+                               _("must be a power of two not larger than 256"));
+    return NULL;
+  }
+  if (env->quota + GNUNET_SERVER_MAX_MESSAGE_SIZE >= UINT32_MAX)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               env->section,
+                               "QUOTA",
+                               _("must be smaller than 4 GB"));
+    return NULL;
+  }
+  plugin = GNUNET_new (struct Plugin);
+  plugin->env = env;
+  plugin->num_shards = (unsigned int) num_shards;
+  while (num_shards > 1)
+  {
+    plugin->shard_bits++;
+    num_shards /= 2;
+  }
+  /* a shard may hold everything, so that uneven key distributions do
+     not make it evict before the datacache reaches its quota; plus
+     room for one value, as the datacache evicts after storing */
+  plugin->max_capacity = env->quota + GNUNET_SERVER_MAX_MESSAGE_SIZE;
+  plugin->shards = GNUNET_new_array (plugin->num_shards,
+                                     struct Shard);
+  api = GNUNET_new (struct GNUNET_DATACACHE_PluginFunctions);
+  api->cls = plugin;
+  api->get = &shard_plugin_get;
+  api->put = &shard_plugin_put;
+  api->del = &shard_plugin_del;
+  api->get_random = &shard_plugin_get_random;
+  api->get_closest = &shard_plugin_get_closest;
+  LOG (GNUNET_ERROR_TYPE_INFO,
+       _("Sharded datacache running with %u shards\n"),
+       plugin->num_shards);
+  return api;
+}
+
+
+/**
+ * Exit point from the plugin.
+ *
+ * @param cls closure (our "struct Plugin")
+ * @return NULL
+ */
+void *
+libgnunet_plugin_datacache_shard_done (void *cls)
+{
+  struct GNUNET_DATACACHE_PluginFunctions *api = cls;
+  struct Plugin *plugin = api->cls;
+  unsigned int i;
+
+  for (i = 0; i < plugin->num_shards; i++)
+  {
+    GNUNET_free_non_null (plugin->shards[i].arena);
+    GNUNET_array_grow (plugin->shards[i].index,
+                       plugin->shards[i].index_size,
+                       0);
+  }
+  GNUNET_free (plugin->shards);
+  GNUNET_free (plugin);
+  GNUNET_free (api);
+  return NULL;
+}
+
+
+
+/* end of plugin_datacache_shard.c */
@@ -39,6 +39,23 @@
  */
 #define OVERHEAD (sizeof(struct GNUNET_HashCode) + 32)
 
+/**
+ * How many PUTs do we group into one transaction at most before
+ * committing?
+ */
+#define MAX_BATCH_PUTS 128
+
+/**
+ * How long do we keep a transaction with pending PUTs open at most?
+ */
+#define COMMIT_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
+/**
+ * How many expired entries do we remove at most with one range
+ * delete?
+ */
+#define MAX_EXPIRED_BATCH 64
+
 /**
  * Context for all functions in this plugin.
  */
@@ -59,10 +76,67 @@ struct Plugin
    */
   char *fn;
 
+  /**
+   * Prepared statement for #sqlite_plugin_put.
+   */
+  sqlite3_stmt *insert_stmt;
+
+  /**
+   * Prepared statement for counting the results in #sqlite_plugin_get.
+   */
+  sqlite3_stmt *get_count_stmt;
+
+  /**
+   * Prepared statement for fetching one result in #sqlite_plugin_get.
+   */
+  sqlite3_stmt *get_stmt;
+
+  /**
+   * Prepared statement for finding the entry with the lowest
+   * expiration time in #sqlite_plugin_del.
+   */
+  sqlite3_stmt *del_select_stmt;
+
+  /**
+   * Prepared statement for deleting one row by ROWID.
+   */
+  sqlite3_stmt *del_stmt;
+
+  /**
+   * Prepared statement for selecting a batch of expired entries.
+   */
+  sqlite3_stmt *del_expired_select_stmt;
+
+  /**
+   * Prepared statement for the range delete of expired entries.
+   */
+  sqlite3_stmt *del_expired_stmt;
+
+  /**
+   * Prepared statement for #sqlite_plugin_get_random.
+   */
+  sqlite3_stmt *get_random_stmt;
+
+  /**
+   * Prepared statement for #sqlite_plugin_get_closest.
+   */
+  sqlite3_stmt *get_closest_stmt;
+
+  /**
+   * Task that commits the currently open transaction, NULL if
+   * no transaction is pending.
+   */
+  struct GNUNET_SCHEDULER_Task *commit_task;
+
   /**
    * Number of key-value pairs in the database.
    */
   unsigned int num_items;
+
+  /**
+   * Number of PUTs in the currently open transaction.
+   */
+  unsigned int batch_size;
 };
 
 
@@ -101,10 +175,71 @@ sq_prepare (sqlite3 *dbh,
 {                               /* OUT: Statement handle */
   char *dummy;
 
-  return sqlite3_prepare (dbh,
-                          zSql, strlen (zSql),
-                          ppStmt,
-                          (const char **) &dummy);
+  return sqlite3_prepare_v2 (dbh,
+                             zSql, strlen (zSql),
+                             ppStmt,
+                             (const char **) &dummy);
+}
+
+
+/**
+ * Reset a prepared statement after use, logging failures.
+ *
+ * @param plugin our plugin
+ * @param stmt statement to reset
+ */
+static void
+sq_reset (struct Plugin *plugin,
+          sqlite3_stmt *stmt)
+{
+  if (SQLITE_OK != sqlite3_reset (stmt))
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_reset");
+}
+
+
+/**
+ * Commit the currently open transaction (if any), making all
+ * batched PUTs visible on disk.
+ *
+ * @param plugin our plugin
+ */
+static void
+commit_batch (struct Plugin *plugin)
+{
+  char *emsg;
+
+  if (NULL != plugin->commit_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->commit_task);
+    plugin->commit_task = NULL;
+  }
+  if (sqlite3_get_autocommit (plugin->dbh))
+    return;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Committing batch of %u PUTs\n",
+       plugin->batch_size);
+  SQLITE3_EXEC (plugin->dbh, "COMMIT");
+  plugin->batch_size = 0;
+}
+
+
+/**
+ * Task run to commit the pending transaction once the
+ * #COMMIT_DELAY has passed.
+ *
+ * @param cls our `struct Plugin`
+ * @param tc scheduler context
+ */
+static void
+commit_task_cb (void *cls,
+                const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->commit_task = NULL;
+  commit_batch (plugin);
 }
 
 
@@ -132,8 +267,9 @@ sqlite_plugin_put (void *cls,
 		   const struct GNUNET_PeerIdentity *path_info)
 {
   struct Plugin *plugin = cls;
-  sqlite3_stmt *stmt;
+  sqlite3_stmt *stmt = plugin->insert_stmt;
   int64_t dval;
+  char *emsg;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Processing PUT of %u bytes with key `%4s' and expiration %s\n",
@@ -143,15 +279,12 @@ sqlite_plugin_put (void *cls,
   dval = (int64_t) discard_time.abs_value_us;
   if (dval < 0)
     dval = INT64_MAX;
-  if (sq_prepare
-      (plugin->dbh,
-       "INSERT INTO ds090 (type, expire, key, value, path) VALUES (?, ?, ?, ?, ?)",
-       &stmt) != SQLITE_OK)
+  if (sqlite3_get_autocommit (plugin->dbh))
   {
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
-    return -1;
+    /* start a new batch; it is committed once it is full or
+       #COMMIT_DELAY has passed, whatever comes first */
+    SQLITE3_EXEC (plugin->dbh, "BEGIN");
+    plugin->batch_size = 0;
   }
   if ((SQLITE_OK != sqlite3_bind_int (stmt, 1, type)) ||
       (SQLITE_OK != sqlite3_bind_int64 (stmt, 2, dval)) ||
@@ -170,7 +303,7 @@ sqlite_plugin_put (void *cls,
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind_xxx");
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return -1;
   }
   if (SQLITE_DONE != sqlite3_step (stmt))
@@ -178,14 +311,19 @@ sqlite_plugin_put (void *cls,
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_step");
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return -1;
   }
+  sq_reset (plugin, stmt);
   plugin->num_items++;
-  if (SQLITE_OK != sqlite3_finalize (stmt))
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite3_finalize");
+  plugin->batch_size++;
+  if (plugin->batch_size >= MAX_BATCH_PUTS)
+    commit_batch (plugin);
+  else if ( (NULL == plugin->commit_task) &&
+            (! sqlite3_get_autocommit (plugin->dbh)) )
+    plugin->commit_task = GNUNET_SCHEDULER_add_delayed (COMMIT_DELAY,
+                                                        &commit_task_cb,
+                                                        plugin);
   return size + OVERHEAD;
 }
 
@@ -218,24 +356,15 @@ sqlite_plugin_get (void *cls,
   unsigned int off;
   unsigned int total;
   unsigned int psize;
-  char scratch[256];
   int64_t ntime;
   const struct GNUNET_PeerIdentity *path;
+  int ret;
 
   now = GNUNET_TIME_absolute_get ();
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Processing GET for key `%4s'\n",
        GNUNET_h2s (key));
-  if (sq_prepare
-      (plugin->dbh,
-       "SELECT count(*) FROM ds090 WHERE key=? AND type=? AND expire >= ?",
-       &stmt) != SQLITE_OK)
-  {
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
-    return 0;
-  }
+  stmt = plugin->get_count_stmt;
   ntime = (int64_t) now.abs_value_us;
   GNUNET_assert (ntime >= 0);
   if ((SQLITE_OK !=
@@ -247,7 +376,7 @@ sqlite_plugin_get (void *cls,
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind_xxx");
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return 0;
   }
 
@@ -255,14 +384,14 @@ sqlite_plugin_get (void *cls,
   {
     LOG_SQLITE (plugin->dbh, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite_step");
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "No content found when processing GET for key `%4s'\n",
          GNUNET_h2s (key));
     return 0;
   }
   total = sqlite3_column_int (stmt, 0);
-  sqlite3_finalize (stmt);
+  sq_reset (plugin, stmt);
   if ((0 == total) || (NULL == iter))
   {
     if (0 == total)
@@ -272,34 +401,33 @@ sqlite_plugin_get (void *cls,
     return total;
   }
 
+  stmt = plugin->get_stmt;
+  if ((SQLITE_OK !=
+       sqlite3_bind_blob (stmt, 1,
+                          key,
+                          sizeof (struct GNUNET_HashCode),
+                          SQLITE_TRANSIENT)) ||
+      (SQLITE_OK != sqlite3_bind_int (stmt, 2, type)) ||
+      (SQLITE_OK != sqlite3_bind_int64 (stmt, 3, now.abs_value_us)))
+  {
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_bind_xxx");
+    sq_reset (plugin, stmt);
+    return 0;
+  }
   cnt = 0;
   off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, total);
   while (cnt < total)
   {
     off = (off + 1) % total;
-    GNUNET_snprintf (scratch, sizeof (scratch),
-                     "SELECT value,expire,path FROM ds090 WHERE key=? AND type=? AND expire >= ? LIMIT 1 OFFSET %u",
-                     off);
-    if (sq_prepare (plugin->dbh, scratch, &stmt) != SQLITE_OK)
-    {
-      LOG_SQLITE (plugin->dbh,
-                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                  "sq_prepare");
-      return cnt;
-    }
-    if ((SQLITE_OK !=
-         sqlite3_bind_blob (stmt, 1,
-                            key,
-                            sizeof (struct GNUNET_HashCode),
-                            SQLITE_TRANSIENT)) ||
-        (SQLITE_OK != sqlite3_bind_int (stmt, 2, type)) ||
-        (SQLITE_OK != sqlite3_bind_int64 (stmt, 3, now.abs_value_us)))
+    /* the other bindings survive the reset, only the offset changes */
+    if (SQLITE_OK != sqlite3_bind_int (stmt, 4, off))
     {
       LOG_SQLITE (plugin->dbh,
                   GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                   "sqlite3_bind_xxx");
-      sqlite3_finalize (stmt);
-      return cnt;
+      break;
     }
     if (sqlite3_step (stmt) != SQLITE_ROW)
       break;
@@ -325,27 +453,116 @@ sqlite_plugin_get (void *cls,
          "Found %u-byte result when processing GET for key `%4s'\n",
          (unsigned int) size,
          GNUNET_h2s (key));
-    if (GNUNET_OK != iter (iter_cls,
-                           key,
-                           size,
-                           dat,
-                           type,
-                           exp,
-                           psize,
-                           path))
+    ret = iter (iter_cls,
+                key,
+                size,
+                dat,
+                type,
+                exp,
+                psize,
+                path);
+    sq_reset (plugin, stmt);
+    if (GNUNET_OK != ret)
+      break;
+  }
+  sq_reset (plugin, stmt);
+  return cnt;
+}
+
+
+/**
+ * Remove a batch of expired entries from the datacache using
+ * a single range delete on the expiration index.
+ *
+ * @param plugin our plugin
+ * @param now current time
+ * @return number of entries removed, -1 on error
+ */
+static int
+delete_expired (struct Plugin *plugin,
+                struct GNUNET_TIME_Absolute now)
+{
+  sqlite3_stmt *stmt;
+  struct GNUNET_HashCode keys[MAX_EXPIRED_BATCH];
+  unsigned int sizes[MAX_EXPIRED_BATCH];
+  int64_t last_expire;
+  int64_t last_rowid;
+  unsigned int n;
+  unsigned int i;
+  int changes;
+
+  stmt = plugin->del_expired_select_stmt;
+  if ( (SQLITE_OK != sqlite3_bind_int64 (stmt, 1, now.abs_value_us)) ||
+       (SQLITE_OK != sqlite3_bind_int (stmt, 2, MAX_EXPIRED_BATCH)) )
+  {
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_bind_xxx");
+    sq_reset (plugin, stmt);
+    return -1;
+  }
+  n = 0;
+  last_expire = 0;
+  last_rowid = 0;
+  while ( (n < MAX_EXPIRED_BATCH) &&
+          (SQLITE_ROW == sqlite3_step (stmt)) )
+  {
+    if (sizeof (struct GNUNET_HashCode) !=
+        sqlite3_column_bytes (stmt, 1))
     {
-      sqlite3_finalize (stmt);
+      GNUNET_break (0);
       break;
     }
-    sqlite3_finalize (stmt);
+    last_rowid = sqlite3_column_int64 (stmt, 0);
+    memcpy (&keys[n],
+            sqlite3_column_blob (stmt, 1),
+            sizeof (struct GNUNET_HashCode));
+    sizes[n] = sqlite3_column_int (stmt, 2);
+    last_expire = sqlite3_column_int64 (stmt, 3);
+    n++;
   }
-  return cnt;
+  sq_reset (plugin, stmt);
+  if (0 == n)
+    return 0;
+  /* rows come in (expire, ROWID) order, so everything up to and
+     including the last row we saw forms one contiguous range */
+  stmt = plugin->del_expired_stmt;
+  if ( (SQLITE_OK != sqlite3_bind_int64 (stmt, 1, last_expire)) ||
+       (SQLITE_OK != sqlite3_bind_int64 (stmt, 2, last_rowid)) )
+  {
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_bind_xxx");
+    sq_reset (plugin, stmt);
+    return -1;
+  }
+  if (SQLITE_DONE != sqlite3_step (stmt))
+  {
+    LOG_SQLITE (plugin->dbh,
+                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_step");
+    sq_reset (plugin, stmt);
+    return -1;
+  }
+  changes = sqlite3_changes (plugin->dbh);
+  sq_reset (plugin, stmt);
+  GNUNET_break (changes == (int) n);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Removed %u expired entries\n",
+       n);
+  plugin->num_items -= n;
+  for (i = 0; i < n; i++)
+    plugin->env->delete_notify (plugin->env->cls,
+                                &keys[i],
+                                sizes[i] + OVERHEAD);
+  return n;
 }
 
 
 /**
  * Delete the entry with the lowest expiration value
- * from the datacache right now.
+ * from the datacache right now.  If expired entries
+ * exist, a whole batch of them is removed at once.
  *
  * @param cls closure (our `struct Plugin`)
  * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
@@ -357,76 +574,51 @@ sqlite_plugin_del (void *cls)
   unsigned long long rowid;
   unsigned int dsize;
   sqlite3_stmt *stmt;
-  sqlite3_stmt *dstmt;
   struct GNUNET_HashCode hc;
+  int ret;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Processing DEL\n");
-  stmt = NULL;
-  dstmt = NULL;
-  if (SQLITE_OK !=
-      sq_prepare (plugin->dbh,
-                  "SELECT _ROWID_,key,value FROM ds090 ORDER BY expire ASC LIMIT 1",
-                  &stmt))
-  {
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
-    if (stmt != NULL)
-      (void) sqlite3_finalize (stmt);
-    return GNUNET_SYSERR;
-  }
+  ret = delete_expired (plugin,
+                        GNUNET_TIME_absolute_get ());
+  if (ret > 0)
+    return GNUNET_OK;
+  stmt = plugin->del_select_stmt;
   if (SQLITE_ROW != sqlite3_step (stmt))
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_step");
-    (void) sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return GNUNET_SYSERR;
   }
   rowid = sqlite3_column_int64 (stmt, 0);
   GNUNET_assert (sqlite3_column_bytes (stmt, 1) == sizeof (struct GNUNET_HashCode));
   memcpy (&hc, sqlite3_column_blob (stmt, 1), sizeof (struct GNUNET_HashCode));
-  dsize = sqlite3_column_bytes (stmt, 2);
-  if (SQLITE_OK != sqlite3_finalize (stmt))
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite3_step");
-  if (SQLITE_OK !=
-      sq_prepare (plugin->dbh,
-                  "DELETE FROM ds090 WHERE _ROWID_=?", &dstmt))
-  {
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
-    if (stmt != NULL)
-      (void) sqlite3_finalize (stmt);
-    return GNUNET_SYSERR;
-  }
-  if (SQLITE_OK != sqlite3_bind_int64 (dstmt, 1, rowid))
+  dsize = sqlite3_column_int (stmt, 2);
+  sq_reset (plugin, stmt);
+  stmt = plugin->del_stmt;
+  if (SQLITE_OK != sqlite3_bind_int64 (stmt, 1, rowid))
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind");
-    (void) sqlite3_finalize (dstmt);
+    sq_reset (plugin, stmt);
     return GNUNET_SYSERR;
   }
-  if (SQLITE_DONE != sqlite3_step (dstmt))
+  if (SQLITE_DONE != sqlite3_step (stmt))
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_step");
-    (void) sqlite3_finalize (dstmt);
+    sq_reset (plugin, stmt);
     return GNUNET_SYSERR;
   }
+  sq_reset (plugin, stmt);
   plugin->num_items--;
   plugin->env->delete_notify (plugin->env->cls,
                               &hc,
                               dsize + OVERHEAD);
-  if (SQLITE_OK != sqlite3_finalize (dstmt))
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite3_finalize");
   return GNUNET_OK;
 }
 
@@ -445,14 +637,13 @@ sqlite_plugin_get_random (void *cls,
                           void *iter_cls)
 {
   struct Plugin *plugin = cls;
-  sqlite3_stmt *stmt;
+  sqlite3_stmt *stmt = plugin->get_random_stmt;
   struct GNUNET_TIME_Absolute exp;
   unsigned int size;
   const char *dat;
   unsigned int off;
   unsigned int psize;
   unsigned int type;
-  char scratch[256];
   int64_t ntime;
   const struct GNUNET_PeerIdentity *path;
   const struct GNUNET_HashCode *key;
@@ -463,22 +654,18 @@ sqlite_plugin_get_random (void *cls,
     return 1;
   off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
                                   plugin->num_items);
-  GNUNET_snprintf (scratch,
-                   sizeof (scratch),
-                   "SELECT value,expire,path,key,type FROM ds090 ORDER BY key LIMIT 1 OFFSET %u",
-                   off);
-  if (SQLITE_OK !=
-      sq_prepare (plugin->dbh, scratch, &stmt))
+  if (SQLITE_OK != sqlite3_bind_int (stmt, 1, off))
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
+                "sqlite3_bind_xxx");
+    sq_reset (plugin, stmt);
     return 0;
   }
   if (SQLITE_ROW != sqlite3_step (stmt))
   {
     GNUNET_break (0);
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return 0;
   }
   size = sqlite3_column_bytes (stmt, 0);
@@ -516,7 +703,7 @@ sqlite_plugin_get_random (void *cls,
                exp,
                psize,
                path);
-  sqlite3_finalize (stmt);
+  sq_reset (plugin, stmt);
   return 1;
 }
 
@@ -542,7 +729,7 @@ sqlite_plugin_get_closest (void *cls,
                            void *iter_cls)
 {
   struct Plugin *plugin = cls;
-  sqlite3_stmt *stmt;
+  sqlite3_stmt *stmt = plugin->get_closest_stmt;
   struct GNUNET_TIME_Absolute now;
   struct GNUNET_TIME_Absolute exp;
   unsigned int size;
@@ -557,16 +744,6 @@ sqlite_plugin_get_closest (void *cls,
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Processing GET_CLOSEST for key `%4s'\n",
        GNUNET_h2s (key));
-  if (SQLITE_OK !=
-      sq_prepare (plugin->dbh,
-                  "SELECT value,expire,path,type,key FROM ds090 WHERE key>=? AND expire >= ? ORDER BY KEY ASC LIMIT ?",
-                  &stmt))
-  {
-    LOG_SQLITE (plugin->dbh,
-                GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sq_prepare");
-    return 0;
-  }
   ntime = (int64_t) now.abs_value_us;
   GNUNET_assert (ntime >= 0);
   if ((SQLITE_OK !=
@@ -576,12 +753,12 @@ sqlite_plugin_get_closest (void *cls,
                           sizeof (struct GNUNET_HashCode),
                           SQLITE_TRANSIENT)) ||
       (SQLITE_OK != sqlite3_bind_int64 (stmt, 2, now.abs_value_us)) ||
-      (SQLITE_OK != sqlite3_bind_int (stmt, 3, num_results)) )
+      (SQLITE_OK != sqlite3_bind_int64 (stmt, 3, num_results)) )
   {
     LOG_SQLITE (plugin->dbh,
                 GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind_xxx");
-    sqlite3_finalize (stmt);
+    sq_reset (plugin, stmt);
     return 0;
   }
   cnt = 0;
@@ -625,16 +802,17 @@ sqlite_plugin_get_closest (void *cls,
                            exp,
                            psize,
                            path))
-    {
-      sqlite3_finalize (stmt);
       break;
-    }
   }
-  sqlite3_finalize (stmt);
+  sq_reset (plugin, stmt);
   return cnt;
 }
 
 
+void *
+libgnunet_plugin_datacache_sqlite_done (void *cls);
+
+
 /**
  * Entry point for the plugin.
  *
@@ -644,18 +822,24 @@ sqlite_plugin_get_closest (void *cls,
 void *
 libgnunet_plugin_datacache_sqlite_init (void *cls)
 {
+  static const char *const journal_modes[] = {
+    "WAL", "OFF", "MEMORY", "DELETE", "TRUNCATE", "PERSIST", NULL
+  };
   struct GNUNET_DATACACHE_PluginEnvironment *env = cls;
   struct GNUNET_DATACACHE_PluginFunctions *api;
   struct Plugin *plugin;
   char *fn;
   char *fn_utf8;
+  char *pragma;
+  const char *journal_mode;
   sqlite3 *dbh;
   char *emsg;
+  int in_memory;
 
-  if (GNUNET_YES ==
-      GNUNET_CONFIGURATION_get_value_yesno (env->cfg,
-					    "datacache-sqlite",
-					    "IN_MEMORY"))
+  in_memory = GNUNET_CONFIGURATION_get_value_yesno (env->cfg,
+                                                    "datacache-sqlite",
+                                                    "IN_MEMORY");
+  if (GNUNET_YES == in_memory)
   {
     if (SQLITE_OK != sqlite3_open (":memory:", &dbh))
       return NULL;
@@ -682,13 +866,30 @@ libgnunet_plugin_datacache_sqlite_init (void *cls)
 
   SQLITE3_EXEC (dbh, "PRAGMA temp_store=MEMORY");
   SQLITE3_EXEC (dbh, "PRAGMA locking_mode=EXCLUSIVE");
-  SQLITE3_EXEC (dbh, "PRAGMA journal_mode=OFF");
+  if (GNUNET_YES == in_memory)
+  {
+    SQLITE3_EXEC (dbh, "PRAGMA journal_mode=OFF");
+  }
+  else
+  {
+    /* WAL turns each commit into a sequential append; with the
+       exclusive lock no shared-memory index is needed either */
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_choice (env->cfg,
+                                               "datacache-sqlite",
+                                               "JOURNAL_MODE",
+                                               journal_modes,
+                                               &journal_mode))
+      journal_mode = "WAL";
+    GNUNET_asprintf (&pragma,
+                     "PRAGMA journal_mode=%s",
+                     journal_mode);
+    SQLITE3_EXEC (dbh, pragma);
+    GNUNET_free (pragma);
+  }
   SQLITE3_EXEC (dbh, "PRAGMA synchronous=OFF");
   SQLITE3_EXEC (dbh, "PRAGMA page_size=4092");
-  if (GNUNET_YES ==
-      GNUNET_CONFIGURATION_get_value_yesno (env->cfg,
-					    "datacache-sqlite",
-					    "IN_MEMORY"))
+  if (GNUNET_YES == in_memory)
     SQLITE3_EXEC (dbh, "PRAGMA sqlite_temp_store=3");
 
   SQLITE3_EXEC (dbh,
@@ -703,6 +904,57 @@ libgnunet_plugin_datacache_sqlite_init (void *cls)
   plugin->env = env;
   plugin->dbh = dbh;
   plugin->fn = fn_utf8;
+  if ( (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "INSERT INTO ds090 (type, expire, key, value, path) VALUES (?, ?, ?, ?, ?)",
+                    &plugin->insert_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT count(*) FROM ds090 WHERE key=? AND type=? AND expire >= ?",
+                    &plugin->get_count_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT value,expire,path FROM ds090 WHERE key=? AND type=? AND expire >= ? LIMIT 1 OFFSET ?",
+                    &plugin->get_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT _ROWID_,key,LENGTH(value) FROM ds090 ORDER BY expire ASC LIMIT 1",
+                    &plugin->del_select_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "DELETE FROM ds090 WHERE _ROWID_=?",
+                    &plugin->del_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT _ROWID_,key,LENGTH(value),expire FROM ds090 "
+                    "WHERE expire < ?1 ORDER BY expire ASC, _ROWID_ ASC LIMIT ?2",
+                    &plugin->del_expired_select_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "DELETE FROM ds090 "
+                    "WHERE expire < ?1 OR (expire = ?1 AND _ROWID_ <= ?2)",
+                    &plugin->del_expired_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT value,expire,path,key,type FROM ds090 ORDER BY key LIMIT 1 OFFSET ?",
+                    &plugin->get_random_stmt)) ||
+       (SQLITE_OK !=
+        sq_prepare (dbh,
+                    "SELECT value,expire,path,type,key FROM ds090 "
+#if SQLITE_VERSION_NUMBER >= 3007000
+                    "INDEXED BY idx_hashidx "
+#endif
+                    "WHERE key>=? AND expire >= ? ORDER BY KEY ASC LIMIT ?",
+                    &plugin->get_closest_stmt)) )
+  {
+    LOG_SQLITE (dbh,
+                GNUNET_ERROR_TYPE_ERROR,
+                "precompiling");
+    api = GNUNET_new (struct GNUNET_DATACACHE_PluginFunctions);
+    api->cls = plugin;
+    (void) libgnunet_plugin_datacache_sqlite_done (api);
+    return NULL;
+  }
   api = GNUNET_new (struct GNUNET_DATACACHE_PluginFunctions);
   api->cls = plugin;
   api->get = &sqlite_plugin_get;
@@ -733,6 +985,25 @@ libgnunet_plugin_datacache_sqlite_done (void *cls)
   sqlite3_stmt *stmt;
 #endif
 
+  commit_batch (plugin);
+  if (NULL != plugin->insert_stmt)
+    sqlite3_finalize (plugin->insert_stmt);
+  if (NULL != plugin->get_count_stmt)
+    sqlite3_finalize (plugin->get_count_stmt);
+  if (NULL != plugin->get_stmt)
+    sqlite3_finalize (plugin->get_stmt);
+  if (NULL != plugin->del_select_stmt)
+    sqlite3_finalize (plugin->del_select_stmt);
+  if (NULL != plugin->del_stmt)
+    sqlite3_finalize (plugin->del_stmt);
+  if (NULL != plugin->del_expired_select_stmt)
+    sqlite3_finalize (plugin->del_expired_select_stmt);
+  if (NULL != plugin->del_expired_stmt)
+    sqlite3_finalize (plugin->del_expired_stmt);
+  if (NULL != plugin->get_random_stmt)
+    sqlite3_finalize (plugin->get_random_stmt);
+  if (NULL != plugin->get_closest_stmt)
+    sqlite3_finalize (plugin->get_closest_stmt);
 #if !WINDOWS || defined(__CYGWIN__)
   if ( (NULL != plugin->fn) &&
        (0 != UNLINK (plugin->fn)) )
@@ -778,7 +1049,3 @@ libgnunet_plugin_datacache_sqlite_done (void *cls)
   GNUNET_free (api);
   return NULL;
 }
-
-
-
-/* end of plugin_datacache_sqlite.c */
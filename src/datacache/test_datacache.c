@@ -60,6 +60,22 @@ checkIt (void *cls,
 }
 
 
+static int
+stopAfter (void *cls,
+           const struct GNUNET_HashCode *key,
+           size_t size, const char *data,
+           enum GNUNET_BLOCK_Type type,
+           struct GNUNET_TIME_Absolute exp,
+           unsigned int path_len,
+           const struct GNUNET_PeerIdentity *path)
+{
+  unsigned int *left = cls;
+
+  (*left)--;
+  return (0 == *left) ? GNUNET_NO : GNUNET_OK;
+}
+
+
 static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
@@ -69,6 +85,7 @@ run (void *cls, char *const *args, const char *cfgfile,
   struct GNUNET_HashCode n;
   struct GNUNET_TIME_Absolute exp;
   unsigned int i;
+  unsigned int left;
 
   ok = 0;
   h = GNUNET_DATACACHE_create (cfg, "testcache");
@@ -108,6 +125,10 @@ run (void *cls, char *const *args, const char *cfgfile,
 				0, NULL));
   ASSERT (0 != GNUNET_DATACACHE_get (h, &k, 792, &checkIt, &n));
 
+  memset (&k, 0, sizeof (struct GNUNET_HashCode));
+  left = 10;
+  ASSERT (10 == GNUNET_DATACACHE_scan (h, &k, &stopAfter, &left));
+
   GNUNET_DATACACHE_destroy (h);
   ASSERT (ok == 0);
   return;
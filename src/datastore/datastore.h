@@ -255,6 +255,104 @@ struct DataMessage
   struct GNUNET_HashCode key;
 
 };
+
+
+/**
+ * Message to the datastore service storing several items in one
+ * request.  Followed by @e count messages of type
+ * #GNUNET_MESSAGE_TYPE_DATASTORE_PUT (`struct DataMessage` plus
+ * payload each).  The service answers with a single status message.
+ */
+struct PutBatchMessage
+{
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_DATASTORE_PUT_BATCH.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of PUT messages that follow.
+   */
+  uint32_t count GNUNET_PACKED;
+
+};
+
+
+/**
+ * Message to the datastore service asking for content under
+ * several keys.  Followed by @e count keys.  The service answers
+ * with one DATA message per key that has a match, followed by a
+ * DATA_END message.
+ */
+struct GetMultiMessage
+{
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_DATASTORE_GET_MULTI.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Desired content type.  (actually an enum GNUNET_BLOCK_Type)
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Number of keys that follow.
+   */
+  uint32_t count GNUNET_PACKED;
+
+};
+
+
+/**
+ * Message to the datastore service asking for several values for
+ * replication.  The service answers with up to @e count DATA
+ * messages, followed by a DATA_END message.
+ */
+struct GetReplicationMultiMessage
+{
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_DATASTORE_GET_REPLICATION_MULTI.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Maximum number of values to return.
+   */
+  uint32_t count GNUNET_PACKED;
+
+};
+
+
+/**
+ * Message to the datastore service asking for several zero
+ * anonymity values, starting at a given offset.  The service
+ * answers with up to @e count DATA messages for consecutive
+ * offsets, followed by a DATA_END message.
+ */
+struct GetZeroAnonymityMultiMessage
+{
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_DATASTORE_GET_ZERO_ANONYMITY_MULTI.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Desired content type (actually an enum GNUNET_BLOCK_Type)
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Maximum number of values to return.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /**
+   * Offset of the first result.
+   */
+  uint64_t offset GNUNET_PACKED;
+
+};
 GNUNET_NETWORK_STRUCT_END
 
 
@@ -46,6 +46,13 @@
  */
 #define MAX_EXCESS_RESULTS 8
 
+/**
+ * How many requests do we transmit to the service before waiting
+ * for the reply to the first of them?  The service answers in
+ * order, so replies are matched against the head of our queue.
+ */
+#define MAX_PIPELINE 16
+
 /**
  * Context for processing status messages.
  */
@@ -169,7 +176,8 @@ struct GNUNET_DATASTORE_QueueEntry
 
   /**
    * Has this message been transmitted to the service?
-   * Only ever GNUNET_YES for the head of the queue.
+   * Only ever GNUNET_YES for a prefix of the queue (the
+   * requests whose replies we are waiting for, in order).
    * Note that the overall struct should end at a
    * multiple of 64 bits.
    */
@@ -237,14 +245,15 @@ struct GNUNET_DATASTORE_Handle
   unsigned int result_count;
 
   /**
-   * Are we currently trying to receive from the service?
+   * Number of requests at the head of the queue that were
+   * transmitted and are waiting for their reply.
    */
-  int in_receive;
+  unsigned int num_transmitted;
 
   /**
-   * We should ignore the next message(s) from the service.
+   * Are we currently trying to receive from the service?
    */
-  unsigned int skip_next_messages;
+  int in_receive;
 
 };
 
@@ -435,6 +444,7 @@ make_queue_entry (struct GNUNET_DATASTORE_Handle *h,
 {
   struct GNUNET_DATASTORE_QueueEntry *ret;
   struct GNUNET_DATASTORE_QueueEntry *pos;
+  struct GNUNET_DATASTORE_QueueEntry *tx;
   unsigned int c;
 
   c = 0;
@@ -468,10 +478,21 @@ make_queue_entry (struct GNUNET_DATASTORE_Handle *h,
   else
   {
     pos = pos->prev;
-    /* do not insert at HEAD if HEAD query was already
-     * transmitted and we are still receiving replies! */
-    if ((pos == NULL) && (h->queue_head->was_transmitted))
-      pos = h->queue_head;
+  }
+  /* never insert before requests that were already transmitted,
+   * their replies arrive in transmission order! */
+  if ( (NULL == pos) ||
+       (GNUNET_YES == pos->was_transmitted) )
+  {
+    struct GNUNET_DATASTORE_QueueEntry *last;
+
+    last = NULL;
+    for (tx = h->queue_head;
+         (NULL != tx) && (GNUNET_YES == tx->was_transmitted);
+         tx = tx->next)
+      last = tx;
+    if (NULL != last)
+      pos = last;
   }
   c++;
 #if INSANE_STATISTICS
@@ -553,15 +574,33 @@ try_reconnect (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 static void
 do_disconnect (struct GNUNET_DATASTORE_Handle *h)
 {
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+
   if (NULL == h->client)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Client NULL in disconnect, will not try to reconnect\n");
     return;
   }
+  if (NULL != h->th)
+  {
+    GNUNET_CLIENT_notify_transmit_ready_cancel (h->th);
+    h->th = NULL;
+  }
   GNUNET_CLIENT_disconnect (h->client);
-  h->skip_next_messages = 0;
+  h->in_receive = GNUNET_NO;
   h->client = NULL;
+  /* requests still in the pipeline are lost with the connection;
+   * send them again once we have reconnected */
+  for (qe = h->queue_head;
+       (NULL != qe) && (GNUNET_YES == qe->was_transmitted);
+       qe = qe->next)
+  {
+    qe->was_transmitted = GNUNET_NO;
+    qe->task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (qe->timeout),
+                                             &timeout_queue_entry, qe);
+  }
+  h->num_transmitted = 0;
   h->reconnect_task =
       GNUNET_SCHEDULER_add_delayed (h->retry_time, &try_reconnect, h);
 }
@@ -584,13 +623,8 @@ receive_cb (void *cls,
   h->in_receive = GNUNET_NO;
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Receiving reply from datastore\n");
-  if (h->skip_next_messages > 0)
-  {
-    h->skip_next_messages--;
-    process_queue (h);
-    return;
-  }
-  if (NULL == (qe = h->queue_head))
+  if ( (NULL == (qe = h->queue_head)) ||
+       (GNUNET_YES != qe->was_transmitted) )
   {
     GNUNET_break (0);
     process_queue (h);
@@ -618,8 +652,11 @@ transmit_request (void *cls,
   size_t msize;
 
   h->th = NULL;
-  if (NULL == (qe = h->queue_head))
-    return 0;                   /* no entry in queue */
+  for (qe = h->queue_head;
+       (NULL != qe) && (GNUNET_YES == qe->was_transmitted);
+       qe = qe->next) ;
+  if (NULL == qe)
+    return 0;                   /* no untransmitted entry in queue */
   if (NULL == buf)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -640,18 +677,15 @@ transmit_request (void *cls,
        msize);
   memcpy (buf, &qe[1], msize);
   qe->was_transmitted = GNUNET_YES;
+  h->num_transmitted++;
   GNUNET_SCHEDULER_cancel (qe->task);
   qe->task = NULL;
-  GNUNET_assert (GNUNET_NO == h->in_receive);
-  h->in_receive = GNUNET_YES;
-  GNUNET_CLIENT_receive (h->client,
-                         &receive_cb, h,
-                         GNUNET_TIME_absolute_get_remaining (qe->timeout));
 #if INSANE_STATISTICS
   GNUNET_STATISTICS_update (h->stats,
                             gettext_noop ("# bytes sent to datastore"), msize,
                             GNUNET_NO);
 #endif
+  process_queue (h);
   return msize;
 }
 
@@ -667,18 +701,31 @@ process_queue (struct GNUNET_DATASTORE_Handle *h)
 {
   struct GNUNET_DATASTORE_QueueEntry *qe;
 
-  if (NULL == (qe = h->queue_head))
+  if (NULL == h->client)
   {
-    /* no entry in queue */
+    /* waiting for reconnect */
     LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Queue empty\n");
+         "Not connected\n");
     return;
   }
-  if (GNUNET_YES == qe->was_transmitted)
+  if ( (GNUNET_NO == h->in_receive) &&
+       (h->num_transmitted > 0) )
+  {
+    /* replies come in transmission order, so the head of the
+     * queue determines how long we are willing to wait */
+    h->in_receive = GNUNET_YES;
+    GNUNET_CLIENT_receive (h->client,
+                           &receive_cb, h,
+                           GNUNET_TIME_absolute_get_remaining (h->queue_head->timeout));
+  }
+  for (qe = h->queue_head;
+       (NULL != qe) && (GNUNET_YES == qe->was_transmitted);
+       qe = qe->next) ;
+  if (NULL == qe)
   {
-    /* waiting for replies */
+    /* no untransmitted entry in queue */
     LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Head request already transmitted\n");
+         "Queue empty\n");
     return;
   }
   if (NULL != h->th)
@@ -688,16 +735,11 @@ process_queue (struct GNUNET_DATASTORE_Handle *h)
          "Pending transmission request\n");
     return;
   }
-  if (NULL == h->client)
+  if (h->num_transmitted >= MAX_PIPELINE)
   {
-    /* waiting for reconnect */
+    /* wait for responses to previous queries */
     LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Not connected\n");
-    return;
-  }
-  if (GNUNET_YES == h->in_receive)
-  {
-    /* wait for response to previous query */
+         "Pipeline full\n");
     return;
   }
   LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -708,7 +750,6 @@ process_queue (struct GNUNET_DATASTORE_Handle *h)
                                            GNUNET_TIME_absolute_get_remaining (qe->timeout),
                                            GNUNET_YES,
                                            &transmit_request, h);
-  GNUNET_assert (GNUNET_NO == h->in_receive);
   GNUNET_break (NULL != h->th);
 }
 
@@ -748,6 +789,8 @@ free_queue_entry (struct GNUNET_DATASTORE_QueueEntry *qe)
     GNUNET_SCHEDULER_cancel (qe->task);
     qe->task = NULL;
   }
+  if (GNUNET_YES == qe->was_transmitted)
+    h->num_transmitted--;
   h->queue_size--;
   qe->was_transmitted = GNUNET_SYSERR;  /* use-after-free warning */
   GNUNET_free (qe);
@@ -927,6 +970,110 @@ GNUNET_DATASTORE_put (struct GNUNET_DATASTORE_Handle *h,
 }
 
 
+/**
+ * Store several items in the datastore with a single request.  The
+ * service stores all items in one database transaction (if the
+ * plugin supports it) and answers once for the whole batch.
+ *
+ * @param h handle to the datastore
+ * @param rid reservation ID to use (from "reserve"); use 0 if no
+ *            prior reservation was made
+ * @param items items to store
+ * @param item_count number of entries in @a items, must be positive
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout timeout for the operation
+ * @param cont continuation to call when done
+ * @param cont_cls closure for @a cont
+ * @return NULL if the entry was not queued (or the batch is too
+ *         large), otherwise a handle that can be used to cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_put_batch (struct GNUNET_DATASTORE_Handle *h,
+                            uint32_t rid,
+                            const struct GNUNET_DATASTORE_PutItem *items,
+                            unsigned int item_count,
+                            unsigned int queue_priority,
+                            unsigned int max_queue_size,
+                            struct GNUNET_TIME_Relative timeout,
+                            GNUNET_DATASTORE_ContinuationWithStatus cont,
+                            void *cont_cls)
+{
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+  struct PutBatchMessage *pbm;
+  struct DataMessage *dm;
+  char *pos;
+  size_t msize;
+  size_t isize;
+  unsigned int i;
+  union QueueContext qc;
+
+  if (0 == item_count)
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  msize = sizeof (struct PutBatchMessage);
+  for (i = 0; i < item_count; i++)
+  {
+    msize += sizeof (struct DataMessage) + items[i].size;
+    if (msize >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
+    {
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           "Batch of %u items does not fit into a single PUT_BATCH message\n",
+           item_count);
+      return NULL;
+    }
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Asked to put a batch of %u items (%u bytes)\n",
+       item_count, (unsigned int) msize);
+  qc.sc.cont = cont;
+  qc.sc.cont_cls = cont_cls;
+  qe = make_queue_entry (h,
+                         msize,
+                         queue_priority,
+                         max_queue_size,
+                         timeout,
+                         &process_status_message, &qc);
+  if (qe == NULL)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Could not create queue entry for PUT_BATCH\n");
+    return NULL;
+  }
+  GNUNET_STATISTICS_update (h->stats, gettext_noop ("# PUT requests executed"),
+                            item_count, GNUNET_NO);
+  pbm = (struct PutBatchMessage *) &qe[1];
+  pbm->header.type = htons (GNUNET_MESSAGE_TYPE_DATASTORE_PUT_BATCH);
+  pbm->header.size = htons (msize);
+  pbm->count = htonl (item_count);
+  pos = (char *) &pbm[1];
+  for (i = 0; i < item_count; i++)
+  {
+    isize = sizeof (struct DataMessage) + items[i].size;
+    dm = (struct DataMessage *) pos;
+    dm->header.type = htons (GNUNET_MESSAGE_TYPE_DATASTORE_PUT);
+    dm->header.size = htons (isize);
+    dm->rid = htonl (rid);
+    dm->size = htonl ((uint32_t) items[i].size);
+    dm->type = htonl (items[i].type);
+    dm->priority = htonl (items[i].priority);
+    dm->anonymity = htonl (items[i].anonymity);
+    dm->replication = htonl (items[i].replication);
+    dm->reserved = htonl (0);
+    dm->uid = GNUNET_htonll (0);
+    dm->expiration = GNUNET_TIME_absolute_hton (items[i].expiration);
+    dm->key = *items[i].key;
+    memcpy (&dm[1], items[i].data, items[i].size);
+    pos += isize;
+  }
+  process_queue (h);
+  return qe;
+}
+
+
 /**
  * Reserve space in the datastore.  This function should be used
  * to avoid "out of space" failures during a longer sequence of "put"
@@ -1483,6 +1630,264 @@ GNUNET_DATASTORE_get_key (struct GNUNET_DATASTORE_Handle *h,
 }
 
 
+/**
+ * Type of a function to call when we receive a message from the
+ * service in reply to a GET_MULTI request.  Unlike
+ * #process_result_message(), DATA messages do not complete the
+ * request; only DATA_END (or an error) does.
+ *
+ * @param cls closure with the `struct GNUNET_DATASTORE_Handle *`
+ * @param msg message received, NULL on timeout or fatal error
+ */
+static void
+process_multi_result_message (void *cls,
+                              const struct GNUNET_MessageHeader *msg)
+{
+  struct GNUNET_DATASTORE_Handle *h = cls;
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+  struct ResultContext rc;
+  const struct DataMessage *dm;
+
+  qe = h->queue_head;
+  if ( (NULL == msg) ||
+       (NULL == qe) ||
+       (GNUNET_YES != qe->was_transmitted) ||
+       (ntohs (msg->type) != GNUNET_MESSAGE_TYPE_DATASTORE_DATA) ||
+       (ntohs (msg->size) < sizeof (struct DataMessage)) ||
+       (ntohs (msg->size) !=
+        sizeof (struct DataMessage) +
+        ntohl (((const struct DataMessage *) msg)->size)) )
+  {
+    /* end of results, or an error; handled like for a single GET */
+    process_result_message (cls, msg);
+    return;
+  }
+  dm = (const struct DataMessage *) msg;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Received multi-get result %llu with type %u and size %u with key %s\n",
+       (unsigned long long) GNUNET_ntohll (dm->uid), ntohl (dm->type),
+       ntohl (dm->size), GNUNET_h2s (&dm->key));
+  rc = qe->qc.rc;
+  h->retry_time = GNUNET_TIME_UNIT_ZERO;
+  process_queue (h);
+  if (rc.proc != NULL)
+    rc.proc (rc.proc_cls, &dm->key, ntohl (dm->size), &dm[1], ntohl (dm->type),
+             ntohl (dm->priority), ntohl (dm->anonymity),
+             GNUNET_TIME_absolute_ntoh (dm->expiration),
+             GNUNET_ntohll (dm->uid));
+}
+
+
+/**
+ * Get the first result for each of several keys with a single
+ * request.  The processor is called once for every key that has a
+ * matching value and finally once with a NULL key.
+ *
+ * @param h handle to the datastore
+ * @param keys keys to look up
+ * @param key_count number of entries in @a keys
+ * @param type desired type, 0 for any
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param proc function to call on each matching value;
+ *        and with a NULL value at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued (or too many keys were
+ *         given), otherwise a handle that can be used to cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_keys_multi (struct GNUNET_DATASTORE_Handle *h,
+                                 const struct GNUNET_HashCode *keys,
+                                 unsigned int key_count,
+                                 enum GNUNET_BLOCK_Type type,
+                                 unsigned int queue_priority,
+                                 unsigned int max_queue_size,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_DATASTORE_DatumProcessor proc,
+                                 void *proc_cls)
+{
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+  struct GetMultiMessage *gm;
+  union QueueContext qc;
+  size_t msize;
+
+  GNUNET_assert (NULL != proc);
+  if (key_count >= (GNUNET_SERVER_MAX_MESSAGE_SIZE -
+                    sizeof (struct GetMultiMessage)) /
+      sizeof (struct GNUNET_HashCode))
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  msize = sizeof (struct GetMultiMessage) +
+    key_count * sizeof (struct GNUNET_HashCode);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Asked to look for data of type %u under %u keys\n",
+       (unsigned int) type, key_count);
+  qc.rc.proc = proc;
+  qc.rc.proc_cls = proc_cls;
+  qe = make_queue_entry (h,
+                         msize,
+                         queue_priority,
+                         max_queue_size,
+                         timeout,
+                         &process_multi_result_message,
+                         &qc);
+  if (qe == NULL)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Could not queue request for %u keys\n",
+         key_count);
+    return NULL;
+  }
+#if INSANE_STATISTICS
+  GNUNET_STATISTICS_update (h->stats,
+                            gettext_noop ("# GET requests executed"),
+                            key_count,
+                            GNUNET_NO);
+#endif
+  gm = (struct GetMultiMessage *) &qe[1];
+  gm->header.type = htons (GNUNET_MESSAGE_TYPE_DATASTORE_GET_MULTI);
+  gm->header.size = htons (msize);
+  gm->type = htonl (type);
+  gm->count = htonl (key_count);
+  memcpy (&gm[1], keys, key_count * sizeof (struct GNUNET_HashCode));
+  process_queue (h);
+  return qe;
+}
+
+
+/**
+ * Get a stream of values from the datastore for content replication.
+ * Works like #GNUNET_DATASTORE_get_for_replication(), except that
+ * up to @a count values are returned with a single request, each
+ * with its replication score lowered as described there.
+ *
+ * @param h handle to the datastore
+ * @param count maximum number of values to return
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param proc function to call on each value;
+ *        and always once with a value of NULL at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued, otherwise a handle that can be used to
+ *         cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_for_replication_multi (struct GNUNET_DATASTORE_Handle *h,
+                                            unsigned int count,
+                                            unsigned int queue_priority,
+                                            unsigned int max_queue_size,
+                                            struct GNUNET_TIME_Relative timeout,
+                                            GNUNET_DATASTORE_DatumProcessor proc,
+                                            void *proc_cls)
+{
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+  struct GetReplicationMultiMessage *grm;
+  union QueueContext qc;
+
+  GNUNET_assert (NULL != proc);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Asked to get %u replication entries in %s\n",
+       count,
+       GNUNET_STRINGS_relative_time_to_string (timeout, GNUNET_YES));
+  qc.rc.proc = proc;
+  qc.rc.proc_cls = proc_cls;
+  qe = make_queue_entry (h, sizeof (struct GetReplicationMultiMessage),
+                         queue_priority, max_queue_size, timeout,
+                         &process_multi_result_message, &qc);
+  if (NULL == qe)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Could not create queue entry for GET REPLICATION\n");
+    return NULL;
+  }
+  GNUNET_STATISTICS_update (h->stats,
+                            gettext_noop
+                            ("# GET REPLICATION requests executed"), 1,
+                            GNUNET_NO);
+  grm = (struct GetReplicationMultiMessage *) &qe[1];
+  grm->header.type =
+      htons (GNUNET_MESSAGE_TYPE_DATASTORE_GET_REPLICATION_MULTI);
+  grm->header.size = htons (sizeof (struct GetReplicationMultiMessage));
+  grm->count = htonl (count);
+  process_queue (h);
+  return qe;
+}
+
+
+/**
+ * Get several zero-anonymity values from the datastore with a single
+ * request.  Works like #GNUNET_DATASTORE_get_zero_anonymity() for
+ * the offsets @a offset to @a offset + @a count - 1, except that the
+ * stream ends early at the first offset without a value.
+ *
+ * @param h handle to the datastore
+ * @param offset offset of the first result
+ * @param count maximum number of values to return
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param type allowed type for the operation (never zero)
+ * @param proc function to call on each value;
+ *        and always once with a value of NULL at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued, otherwise a handle that can be used to
+ *         cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_zero_anonymity_multi (struct GNUNET_DATASTORE_Handle *h,
+                                           uint64_t offset,
+                                           unsigned int count,
+                                           unsigned int queue_priority,
+                                           unsigned int max_queue_size,
+                                           struct GNUNET_TIME_Relative timeout,
+                                           enum GNUNET_BLOCK_Type type,
+                                           GNUNET_DATASTORE_DatumProcessor proc,
+                                           void *proc_cls)
+{
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+  struct GetZeroAnonymityMultiMessage *m;
+  union QueueContext qc;
+
+  GNUNET_assert (NULL != proc);
+  GNUNET_assert (type != GNUNET_BLOCK_TYPE_ANY);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Asked to get %u zero-anonymity entries of type %d from offset %llu in %s\n",
+       count, type, (unsigned long long) offset,
+       GNUNET_STRINGS_relative_time_to_string (timeout, GNUNET_YES));
+  qc.rc.proc = proc;
+  qc.rc.proc_cls = proc_cls;
+  qe = make_queue_entry (h, sizeof (struct GetZeroAnonymityMultiMessage),
+                         queue_priority, max_queue_size, timeout,
+                         &process_multi_result_message, &qc);
+  if (NULL == qe)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Could not create queue entry for GET ZERO ANONYMITY\n");
+    return NULL;
+  }
+  GNUNET_STATISTICS_update (h->stats,
+                            gettext_noop
+                            ("# GET ZERO ANONYMITY requests executed"), 1,
+                            GNUNET_NO);
+  m = (struct GetZeroAnonymityMultiMessage *) &qe[1];
+  m->header.type =
+      htons (GNUNET_MESSAGE_TYPE_DATASTORE_GET_ZERO_ANONYMITY_MULTI);
+  m->header.size = htons (sizeof (struct GetZeroAnonymityMultiMessage));
+  m->type = htonl ((uint32_t) type);
+  m->count = htonl (count);
+  m->offset = GNUNET_htonll (offset);
+  process_queue (h);
+  return qe;
+}
+
+
 /**
  * Cancel a datastore operation.  The final callback from the
  * operation must not have been done yet.
@@ -1501,8 +1906,10 @@ GNUNET_DATASTORE_cancel (struct GNUNET_DATASTORE_QueueEntry *qe)
        qe->was_transmitted, h->queue_head == qe);
   if (GNUNET_YES == qe->was_transmitted)
   {
-    free_queue_entry (qe);
-    h->skip_next_messages++;
+    /* the reply is still going to arrive in order; keep the
+     * entry in the pipeline but do not report the result */
+    qe->qc.sc.cont = NULL;
+    qe->qc.rc.proc = NULL;
     return;
   }
   free_queue_entry (qe);
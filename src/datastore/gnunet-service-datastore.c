@@ -36,6 +36,18 @@
  */
 #define MAX_PENDING 1024
 
+/**
+ * How many values do we return at most for a single
+ * GET_REPLICATION_MULTI request?
+ */
+#define MAX_REPLICATION_MULTI 64
+
+/**
+ * How many values do we return at most for a single
+ * GET_ZERO_ANONYMITY_MULTI request?
+ */
+#define MAX_ZERO_ANONYMITY_MULTI 64
+
 /**
  * How long are we at most keeping "expired" content
  * past the expiration date in the database?
@@ -48,6 +60,11 @@
  */
 #define MIN_EXPIRE_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 1)
 
+/**
+ * How often do we write the changes to our bloomfilter to disk?
+ */
+#define BF_SYNC_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+
 /**
  * Name under which we store current space consumption.
  */
@@ -181,6 +198,12 @@ static unsigned long long payload;
  */
 static struct GNUNET_SCHEDULER_Task * expired_kill_task;
 
+/**
+ * Identity of the task that periodically writes the
+ * bloomfilter to disk.
+ */
+static struct GNUNET_SCHEDULER_Task * bf_sync_task;
+
 /**
  * Minimum time that content should have to not be discarded instantly
  * (time stamp of any content that we've been discarding recently to
@@ -237,51 +260,14 @@ sync_stats ()
 
 
 /**
- * Context for transmitting replies to clients.
+ * Replies to clients.  Requests are answered strictly in the order in
+ * which they were received, so a client may pipeline several requests
+ * and match the replies against its own queue.
  */
-struct TransmitCallbackContext
-{
-
-  /**
-   * We keep these in a doubly-linked list (for cleanup).
-   */
-  struct TransmitCallbackContext *next;
-
-  /**
-   * We keep these in a doubly-linked list (for cleanup).
-   */
-  struct TransmitCallbackContext *prev;
-
-  /**
-   * The message that we're asked to transmit.
-   */
-  struct GNUNET_MessageHeader *msg;
-
-  /**
-   * Handle for the transmission request.
-   */
-  struct GNUNET_SERVER_TransmitHandle *th;
-
-  /**
-   * Client that we are transmitting to.
-   */
-  struct GNUNET_SERVER_Client *client;
-
-};
-
-
-/**
- * Head of the doubly-linked list (for cleanup).
- */
-static struct TransmitCallbackContext *tcc_head;
+static struct GNUNET_SERVER_NotificationContext *nc;
 
 /**
- * Tail of the doubly-linked list (for cleanup).
- */
-static struct TransmitCallbackContext *tcc_tail;
-
-/**
- * Have we already cleaned up the TCCs and are hence no longer
+ * Have we already cleaned up the reply queues and are hence no longer
  * willing (or able) to transmit anything to anyone?
  */
 static int cleaning_done;
@@ -480,47 +466,27 @@ manage_space (unsigned long long need)
 
 
 /**
- * Function called to notify a client about the socket
- * begin ready to queue more data.  "buf" will be
- * NULL and "size" zero if the socket was closed for
- * writing in the meantime.
+ * Queue the given message for the client without completing the
+ * processing of the current request (used for multi-part replies).
  *
- * @param cls closure
- * @param size number of bytes available in buf
- * @param buf where the callee should write the message
- * @return number of bytes written to buf
+ * @param client target of the message
+ * @param msg message to transmit, will be freed!
  */
-static size_t
-transmit_callback (void *cls, size_t size, void *buf)
+static void
+queue_reply (struct GNUNET_SERVER_Client *client,
+             struct GNUNET_MessageHeader *msg)
 {
-  struct TransmitCallbackContext *tcc = cls;
-  size_t msize;
-
-  tcc->th = NULL;
-  GNUNET_CONTAINER_DLL_remove (tcc_head, tcc_tail, tcc);
-  msize = ntohs (tcc->msg->size);
-  if (size == 0)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Transmission to client failed!\n"));
-    GNUNET_SERVER_receive_done (tcc->client, GNUNET_SYSERR);
-    GNUNET_SERVER_client_drop (tcc->client);
-    GNUNET_free (tcc->msg);
-    GNUNET_free (tcc);
-    return 0;
-  }
-  GNUNET_assert (size >= msize);
-  memcpy (buf, tcc->msg, msize);
-  GNUNET_SERVER_receive_done (tcc->client, GNUNET_OK);
-  GNUNET_SERVER_client_drop (tcc->client);
-  GNUNET_free (tcc->msg);
-  GNUNET_free (tcc);
-  return msize;
+  GNUNET_SERVER_notification_context_add (nc, client);
+  GNUNET_SERVER_notification_context_unicast (nc, client, msg, GNUNET_NO);
+  GNUNET_free (msg);
 }
 
 
 /**
- * Transmit the given message to the client.
+ * Transmit the given message to the client.  The reply is queued and
+ * the server is told that we are ready for the next request right
+ * away, so that the client can keep several requests in flight while
+ * earlier replies are still being written to the socket.
  *
  * @param client target of the message
  * @param msg message to transmit, will be freed!
@@ -528,8 +494,6 @@ transmit_callback (void *cls, size_t size, void *buf)
 static void
 transmit (struct GNUNET_SERVER_Client *client, struct GNUNET_MessageHeader *msg)
 {
-  struct TransmitCallbackContext *tcc;
-
   if (GNUNET_YES == cleaning_done)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
@@ -538,23 +502,8 @@ transmit (struct GNUNET_SERVER_Client *client, struct GNUNET_MessageHeader *msg)
     GNUNET_free (msg);
     return;
   }
-  tcc = GNUNET_new (struct TransmitCallbackContext);
-  tcc->msg = msg;
-  tcc->client = client;
-  if (NULL ==
-      (tcc->th =
-       GNUNET_SERVER_notify_transmit_ready (client, ntohs (msg->size),
-                                            GNUNET_TIME_UNIT_FOREVER_REL,
-                                            &transmit_callback, tcc)))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
-    GNUNET_free (msg);
-    GNUNET_free (tcc);
-    return;
-  }
-  GNUNET_SERVER_client_keep (client);
-  GNUNET_CONTAINER_DLL_insert (tcc_head, tcc_tail, tcc);
+  queue_reply (client, msg);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
 
@@ -586,6 +535,47 @@ transmit_status (struct GNUNET_SERVER_Client *client, int code, const char *msg)
 }
 
 
+/**
+ * Build a DATA message for the given datastore entry.
+ *
+ * @param key key for the content
+ * @param size number of bytes in data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param expiration expiration time for the content
+ * @param uid unique identifier for the datum
+ * @return the message, to be freed by the caller
+ */
+static struct GNUNET_MessageHeader *
+make_data_message (const struct GNUNET_HashCode *key, uint32_t size,
+                   const void *data, enum GNUNET_BLOCK_Type type,
+                   uint32_t priority, uint32_t anonymity,
+                   struct GNUNET_TIME_Absolute expiration, uint64_t uid)
+{
+  struct DataMessage *dm;
+
+  GNUNET_assert (sizeof (struct DataMessage) + size <
+                 GNUNET_SERVER_MAX_MESSAGE_SIZE);
+  dm = GNUNET_malloc (sizeof (struct DataMessage) + size);
+  dm->header.size = htons (sizeof (struct DataMessage) + size);
+  dm->header.type = htons (GNUNET_MESSAGE_TYPE_DATASTORE_DATA);
+  dm->rid = htonl (0);
+  dm->size = htonl (size);
+  dm->type = htonl (type);
+  dm->priority = htonl (priority);
+  dm->anonymity = htonl (anonymity);
+  dm->replication = htonl (0);
+  dm->reserved = htonl (0);
+  dm->expiration = GNUNET_TIME_absolute_hton (expiration);
+  dm->uid = GNUNET_htonll (uid);
+  dm->key = *key;
+  memcpy (&dm[1], data, size);
+  return &dm->header;
+}
+
+
 /**
  * Function that will transmit the given datastore entry
  * to the client.
@@ -612,7 +602,6 @@ transmit_item (void *cls, const struct GNUNET_HashCode * key, uint32_t size,
 {
   struct GNUNET_SERVER_Client *client = cls;
   struct GNUNET_MessageHeader *end;
-  struct DataMessage *dm;
 
   if (key == NULL)
   {
@@ -626,22 +615,6 @@ transmit_item (void *cls, const struct GNUNET_HashCode * key, uint32_t size,
     GNUNET_SERVER_client_drop (client);
     return GNUNET_OK;
   }
-  GNUNET_assert (sizeof (struct DataMessage) + size <
-                 GNUNET_SERVER_MAX_MESSAGE_SIZE);
-  dm = GNUNET_malloc (sizeof (struct DataMessage) + size);
-  dm->header.size = htons (sizeof (struct DataMessage) + size);
-  dm->header.type = htons (GNUNET_MESSAGE_TYPE_DATASTORE_DATA);
-  dm->rid = htonl (0);
-  dm->size = htonl (size);
-  dm->type = htonl (type);
-  dm->priority = htonl (priority);
-  dm->anonymity = htonl (anonymity);
-  dm->replication = htonl (0);
-  dm->reserved = htonl (0);
-  dm->expiration = GNUNET_TIME_absolute_hton (expiration);
-  dm->uid = GNUNET_htonll (uid);
-  dm->key = *key;
-  memcpy (&dm[1], data, size);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Transmitting `%s' message for `%s' of type %u with expiration %s (in: %s)\n",
               "DATA", GNUNET_h2s (key), type,
@@ -652,7 +625,9 @@ transmit_item (void *cls, const struct GNUNET_HashCode * key, uint32_t size,
                             gettext_noop ("# results found"),
                             1,
                             GNUNET_NO);
-  transmit (client, &dm->header);
+  transmit (client,
+            make_data_message (key, size, data, type, priority,
+                               anonymity, expiration, uid));
   GNUNET_SERVER_client_drop (client);
   return GNUNET_OK;
 }
@@ -823,6 +798,37 @@ check_data (const struct GNUNET_MessageHeader *message)
 }
 
 
+/**
+ * Context for a PUT or PUT_BATCH request.  Collects the outcome
+ * of the individual items and answers the client once all of them
+ * are done.
+ */
+struct PutBatch
+{
+  /**
+   * Client to notify on completion.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Error message of the first item that failed, or NULL.
+   */
+  char *emsg;
+
+  /**
+   * Number of items that are not yet done, plus one while
+   * we are still dispatching items.
+   */
+  unsigned int pending;
+
+  /**
+   * Combined status: #GNUNET_SYSERR if any item failed, #GNUNET_OK
+   * if any item was stored, #GNUNET_NO if all were already present.
+   */
+  int status;
+};
+
+
 /**
  * Context for a PUT request used to see if the content is
  * already present.
@@ -830,9 +836,9 @@ check_data (const struct GNUNET_MessageHeader *message)
 struct PutContext
 {
   /**
-   * Client to notify on completion.
+   * Request this item belongs to.
    */
-  struct GNUNET_SERVER_Client *client;
+  struct PutBatch *pb;
 
 #if ! HAVE_UNALIGNED_64_ACCESS
   void *reserved;
@@ -842,10 +848,70 @@ struct PutContext
 };
 
 
+/**
+ * Start processing a PUT or PUT_BATCH request.
+ *
+ * @param client client that sent the request
+ * @return context for the request, with one pending reference
+ *         held by the caller until dispatching is finished
+ */
+static struct PutBatch *
+put_batch_start (struct GNUNET_SERVER_Client *client)
+{
+  struct PutBatch *pb;
+
+  pb = GNUNET_new (struct PutBatch);
+  pb->client = client;
+  pb->pending = 1;
+  pb->status = GNUNET_NO;
+  GNUNET_SERVER_client_keep (client);
+  return pb;
+}
+
+
+/**
+ * One item of a PUT or PUT_BATCH request is done (or we are done
+ * dispatching items).  Once all items are done, report the combined
+ * status to the client.
+ *
+ * @param pb request the item belongs to
+ * @param status #GNUNET_OK if stored, #GNUNET_NO if already present,
+ *        #GNUNET_SYSERR on error
+ * @param msg error message on error
+ */
+static void
+put_item_done (struct PutBatch *pb,
+               int status,
+               const char *msg)
+{
+  if (GNUNET_SYSERR == status)
+  {
+    if (GNUNET_SYSERR != pb->status)
+    {
+      pb->status = GNUNET_SYSERR;
+      if (NULL != msg)
+        pb->emsg = GNUNET_strdup (msg);
+    }
+  }
+  else if ( (GNUNET_OK == status) &&
+            (GNUNET_NO == pb->status) )
+  {
+    pb->status = GNUNET_OK;
+  }
+  GNUNET_assert (pb->pending > 0);
+  if (0 < --pb->pending)
+    return;
+  transmit_status (pb->client, pb->status, pb->emsg);
+  GNUNET_SERVER_client_drop (pb->client);
+  GNUNET_free_non_null (pb->emsg);
+  GNUNET_free (pb);
+}
+
+
 /**
  * Put continuation.
  *
- * @param cls closure
+ * @param cls closure, the `struct PutBatch`
  * @param key key for the item stored
  * @param size size of the item stored
  * @param status #GNUNET_OK or #GNUNET_SYSERROR
@@ -858,7 +924,7 @@ put_continuation (void *cls,
                   int status,
 		  const char *msg)
 {
-  struct GNUNET_SERVER_Client *client = cls;
+  struct PutBatch *pb = cls;
 
   if (GNUNET_OK == status)
   {
@@ -871,8 +937,7 @@ put_continuation (void *cls,
                 "Successfully stored %u bytes under key `%s'\n",
                 size, GNUNET_h2s (key));
   }
-  transmit_status (client, status, msg);
-  GNUNET_SERVER_client_drop (client);
+  put_item_done (pb, status, msg);
   if (quota - reserved - cache_size < payload)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
@@ -888,19 +953,18 @@ put_continuation (void *cls,
 /**
  * Actually put the data message.
  *
- * @param client sender of the message
+ * @param pb request the item belongs to
  * @param dm message with the data to store
  */
 static void
-execute_put (struct GNUNET_SERVER_Client *client,
+execute_put (struct PutBatch *pb,
              const struct DataMessage *dm)
 {
-  GNUNET_SERVER_client_keep (client);
   plugin->api->put (plugin->api->cls, &dm->key, ntohl (dm->size), &dm[1],
                     ntohl (dm->type), ntohl (dm->priority),
                     ntohl (dm->anonymity), ntohl (dm->replication),
                     GNUNET_TIME_absolute_ntoh (dm->expiration),
-                    &put_continuation, client);
+                    &put_continuation, pb);
 }
 
 
@@ -909,10 +973,9 @@ check_present_continuation (void *cls,
 			    int status,
 			    const char *msg)
 {
-  struct GNUNET_SERVER_Client *client = cls;
+  struct PutBatch *pb = cls;
 
-  transmit_status (client, GNUNET_NO, NULL);
-  GNUNET_SERVER_client_drop (client);
+  put_item_done (pb, GNUNET_NO, NULL);
 }
 
 
@@ -950,8 +1013,7 @@ check_present (void *cls,
   dm = (const struct DataMessage *) &pc[1];
   if (key == NULL)
   {
-    execute_put (pc->client, dm);
-    GNUNET_SERVER_client_drop (pc->client);
+    execute_put (pc->pb, dm);
     GNUNET_free (pc);
     return GNUNET_OK;
   }
@@ -971,18 +1033,14 @@ check_present (void *cls,
                            (int32_t) ntohl (dm->priority),
                            GNUNET_TIME_absolute_ntoh (dm->expiration),
                            &check_present_continuation,
-			   pc->client);
+			   pc->pb);
     else
-    {
-      transmit_status (pc->client, GNUNET_NO, NULL);
-      GNUNET_SERVER_client_drop (pc->client);
-    }
+      put_item_done (pc->pb, GNUNET_NO, NULL);
     GNUNET_free (pc);
   }
   else
   {
-    execute_put (pc->client, dm);
-    GNUNET_SERVER_client_drop (pc->client);
+    execute_put (pc->pb, dm);
     GNUNET_free (pc);
   }
   return GNUNET_OK;
@@ -990,32 +1048,26 @@ check_present (void *cls,
 
 
 /**
- * Handle PUT-message.
+ * Store one (already validated) PUT message as part of the
+ * given request.
  *
- * @param cls closure
- * @param client identification of the client
- * @param message the actual message
+ * @param pb request the item belongs to
+ * @param dm the item to store
  */
 static void
-handle_put (void *cls, struct GNUNET_SERVER_Client *client,
-            const struct GNUNET_MessageHeader *message)
+process_put (struct PutBatch *pb,
+             const struct DataMessage *dm)
 {
-  const struct DataMessage *dm = check_data (message);
   int rid;
   struct ReservationList *pos;
   struct PutContext *pc;
   struct GNUNET_HashCode vhash;
   uint32_t size;
 
-  if ((dm == NULL) || (ntohl (dm->type) == 0))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
-    return;
-  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Processing `%s' request for `%s' of type %u\n", "PUT",
               GNUNET_h2s (&dm->key), ntohl (dm->type));
+  pb->pending++;
   rid = ntohl (dm->rid);
   size = ntohl (dm->size);
   if (rid > 0)
@@ -1042,8 +1094,7 @@ handle_put (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_CRYPTO_hash (&dm[1], size, &vhash);
     pc = GNUNET_malloc (sizeof (struct PutContext) + size +
                         sizeof (struct DataMessage));
-    pc->client = client;
-    GNUNET_SERVER_client_keep (client);
+    pc->pb = pb;
     memcpy (&pc[1], dm, size + sizeof (struct DataMessage));
     plugin->api->get_key (plugin->api->cls,
 			  0,
@@ -1054,7 +1105,110 @@ handle_put (void *cls, struct GNUNET_SERVER_Client *client,
 			  pc);
     return;
   }
-  execute_put (client, dm);
+  execute_put (pb, dm);
+}
+
+
+/**
+ * Handle PUT-message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_put (void *cls, struct GNUNET_SERVER_Client *client,
+            const struct GNUNET_MessageHeader *message)
+{
+  const struct DataMessage *dm = check_data (message);
+  struct PutBatch *pb;
+
+  if ((dm == NULL) || (ntohl (dm->type) == 0))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  pb = put_batch_start (client);
+  process_put (pb, dm);
+  put_item_done (pb, GNUNET_NO, NULL);
+}
+
+
+/**
+ * Handle PUT_BATCH-message.  All items are stored within one
+ * plugin batch (transaction) and answered with a single status.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_put_batch (void *cls, struct GNUNET_SERVER_Client *client,
+                  const struct GNUNET_MessageHeader *message)
+{
+  const struct PutBatchMessage *pbm;
+  const struct GNUNET_MessageHeader *hdr;
+  const struct DataMessage *dm;
+  struct PutBatch *pb;
+  const char *pos;
+  uint16_t size;
+  uint16_t left;
+  uint16_t isize;
+  uint32_t count;
+  uint32_t i;
+
+  size = ntohs (message->size);
+  if (size < sizeof (struct PutBatchMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  pbm = (const struct PutBatchMessage *) message;
+  count = ntohl (pbm->count);
+  /* validate all items before touching the database */
+  pos = (const char *) &pbm[1];
+  left = size - sizeof (struct PutBatchMessage);
+  for (i = 0; i < count; i++)
+  {
+    if (left < sizeof (struct DataMessage))
+      break;
+    hdr = (const struct GNUNET_MessageHeader *) pos;
+    isize = ntohs (hdr->size);
+    if ( (isize > left) ||
+         (GNUNET_MESSAGE_TYPE_DATASTORE_PUT != ntohs (hdr->type)) ||
+         (NULL == (dm = check_data (hdr))) ||
+         (0 == ntohl (dm->type)) )
+      break;
+    pos += isize;
+    left -= isize;
+  }
+  if ( (0 == count) ||
+       (i != count) ||
+       (0 != left) )
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# PUT batches received"),
+                            1,
+                            GNUNET_NO);
+  pb = put_batch_start (client);
+  if (NULL != plugin->api->begin_batch)
+    plugin->api->begin_batch (plugin->api->cls);
+  pos = (const char *) &pbm[1];
+  for (i = 0; i < count; i++)
+  {
+    dm = (const struct DataMessage *) pos;
+    pos += ntohs (dm->header.size);
+    process_put (pb, dm);
+  }
+  if (NULL != plugin->api->commit_batch)
+    plugin->api->commit_batch (plugin->api->cls);
+  put_item_done (pb, GNUNET_NO, NULL);
 }
 
 
@@ -1112,6 +1266,112 @@ handle_get (void *cls, struct GNUNET_SERVER_Client *client,
 }
 
 
+/**
+ * Function that will queue the given datastore entry for the
+ * client as part of a GET_MULTI reply.
+ *
+ * @param cls closure, pointer to the client (of type GNUNET_SERVER_Client).
+ * @param key key for the content, NULL if the key had no match
+ * @param size number of bytes in data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param expiration expiration time for the content
+ * @param uid unique identifier for the datum;
+ *        maybe 0 if no unique identifier is available
+ * @return #GNUNET_OK to continue
+ */
+static int
+transmit_multi_item (void *cls, const struct GNUNET_HashCode *key,
+                     uint32_t size, const void *data,
+                     enum GNUNET_BLOCK_Type type, uint32_t priority,
+                     uint32_t anonymity, struct GNUNET_TIME_Absolute expiration,
+                     uint64_t uid)
+{
+  struct GNUNET_SERVER_Client *client = cls;
+
+  if ( (NULL == key) ||
+       (GNUNET_YES == cleaning_done) )
+    return GNUNET_OK;
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# results found"),
+                            1,
+                            GNUNET_NO);
+  queue_reply (client,
+               make_data_message (key, size, data, type, priority,
+                                  anonymity, expiration, uid));
+  return GNUNET_OK;
+}
+
+
+/**
+ * Handle GET_MULTI-message.  Looks up the first result for each
+ * key and finishes the reply with a DATA_END message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_get_multi (void *cls, struct GNUNET_SERVER_Client *client,
+                  const struct GNUNET_MessageHeader *message)
+{
+  const struct GetMultiMessage *msg;
+  const struct GNUNET_HashCode *keys;
+  uint16_t size;
+  uint32_t count;
+  uint32_t i;
+
+  size = ntohs (message->size);
+  if (size < sizeof (struct GetMultiMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  msg = (const struct GetMultiMessage *) message;
+  count = ntohl (msg->count);
+  if ( (count > GNUNET_SERVER_MAX_MESSAGE_SIZE / sizeof (struct GNUNET_HashCode)) ||
+       (size != sizeof (struct GetMultiMessage) +
+        count * sizeof (struct GNUNET_HashCode)) )
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  keys = (const struct GNUNET_HashCode *) &msg[1];
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Processing `%s' request for %u keys of type %u\n", "GET_MULTI",
+              (unsigned int) count, ntohl (msg->type));
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# GET requests received"),
+                            count,
+                            GNUNET_NO);
+  if (NULL != plugin->api->begin_batch)
+    plugin->api->begin_batch (plugin->api->cls);
+  for (i = 0; i < count; i++)
+  {
+    if (GNUNET_YES != GNUNET_CONTAINER_bloomfilter_test (filter, &keys[i]))
+    {
+      GNUNET_STATISTICS_update (stats,
+                                gettext_noop
+                                ("# requests filtered by bloomfilter"),
+                                1,
+                                GNUNET_NO);
+      continue;
+    }
+    plugin->api->get_key (plugin->api->cls, 0, &keys[i], NULL,
+                          ntohl (msg->type), &transmit_multi_item, client);
+  }
+  if (NULL != plugin->api->commit_batch)
+    plugin->api->commit_batch (plugin->api->cls);
+  GNUNET_SERVER_client_keep (client);
+  transmit_item (client, NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS,
+                 0);
+}
+
+
 static void
 update_continuation (void *cls,
 		     int status,
@@ -1175,6 +1435,92 @@ handle_get_replication (void *cls, struct GNUNET_SERVER_Client *client,
 }
 
 
+/**
+ * Closure for #transmit_replication_item(), also used for
+ * GET_ZERO_ANONYMITY_MULTI requests.
+ */
+struct ReplicationMultiContext
+{
+  /**
+   * Client to send the values to.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Set to #GNUNET_YES if the last call found a value.
+   */
+  int found;
+};
+
+
+/**
+ * Queue one value of a GET_REPLICATION_MULTI reply.
+ *
+ * @param cls the `struct ReplicationMultiContext`
+ * @param key key for the content
+ * @param size number of bytes in @a data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param expiration expiration time for the content
+ * @param uid unique identifier for the datum
+ * @return #GNUNET_OK (keep the value)
+ */
+static int
+transmit_replication_item (void *cls, const struct GNUNET_HashCode *key,
+                           uint32_t size, const void *data,
+                           enum GNUNET_BLOCK_Type type, uint32_t priority,
+                           uint32_t anonymity,
+                           struct GNUNET_TIME_Absolute expiration,
+                           uint64_t uid)
+{
+  struct ReplicationMultiContext *rmc = cls;
+
+  rmc->found = (NULL != key) ? GNUNET_YES : GNUNET_NO;
+  return transmit_multi_item (rmc->client, key, size, data, type, priority,
+                              anonymity, expiration, uid);
+}
+
+
+/**
+ * Handle GET_REPLICATION_MULTI-message.  Takes up to the requested
+ * number of values from the plugin's replication order and streams
+ * them back, followed by a DATA_END message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_get_replication_multi (void *cls, struct GNUNET_SERVER_Client *client,
+                              const struct GNUNET_MessageHeader *message)
+{
+  const struct GetReplicationMultiMessage *msg;
+  struct ReplicationMultiContext rmc;
+  uint32_t count;
+  uint32_t i;
+
+  msg = (const struct GetReplicationMultiMessage *) message;
+  count = GNUNET_MIN (ntohl (msg->count), MAX_REPLICATION_MULTI);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Processing `%s' request for %u values\n",
+              "GET_REPLICATION_MULTI", (unsigned int) count);
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# GET REPLICATION requests received"),
+                            1,
+                            GNUNET_NO);
+  rmc.client = client;
+  rmc.found = GNUNET_YES;
+  for (i = 0; (i < count) && (GNUNET_YES == rmc.found); i++)
+    plugin->api->get_replication (plugin->api->cls,
+                                  &transmit_replication_item, &rmc);
+  GNUNET_SERVER_client_keep (client);
+  transmit_item (client, NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS,
+                 0);
+}
+
+
 /**
  * Handle GET_ZERO_ANONYMITY-message.
  *
@@ -1211,6 +1557,55 @@ handle_get_zero_anonymity (void *cls, struct GNUNET_SERVER_Client *client,
 }
 
 
+/**
+ * Handle GET_ZERO_ANONYMITY_MULTI-message.  Returns the values at
+ * up to the requested number of consecutive offsets, stopping at
+ * the first offset without a value, followed by a DATA_END message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_get_zero_anonymity_multi (void *cls, struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *message)
+{
+  const struct GetZeroAnonymityMultiMessage *msg =
+      (const struct GetZeroAnonymityMultiMessage *) message;
+  struct ReplicationMultiContext rmc;
+  enum GNUNET_BLOCK_Type type;
+  uint64_t offset;
+  uint32_t count;
+  uint32_t i;
+
+  type = (enum GNUNET_BLOCK_Type) ntohl (msg->type);
+  if (type == GNUNET_BLOCK_TYPE_ANY)
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  offset = GNUNET_ntohll (msg->offset);
+  count = GNUNET_MIN (ntohl (msg->count), MAX_ZERO_ANONYMITY_MULTI);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Processing `%s' request for %u values\n",
+              "GET_ZERO_ANONYMITY_MULTI", (unsigned int) count);
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# GET ZERO ANONYMITY requests received"),
+                            1,
+                            GNUNET_NO);
+  rmc.client = client;
+  rmc.found = GNUNET_YES;
+  for (i = 0; (i < count) && (GNUNET_YES == rmc.found); i++)
+    plugin->api->get_zero_anonymity (plugin->api->cls,
+                                     offset + i, type,
+                                     &transmit_replication_item, &rmc);
+  GNUNET_SERVER_client_keep (client);
+  transmit_item (client, NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS,
+                 0);
+}
+
+
 /**
  * Callback function that will cause the item that is passed
  * in to be deleted (by returning GNUNET_NO).
@@ -1423,15 +1818,23 @@ static const struct GNUNET_SERVER_MessageHandler handlers[] = {
    GNUNET_MESSAGE_TYPE_DATASTORE_RELEASE_RESERVE,
    sizeof (struct ReleaseReserveMessage)},
   {&handle_put, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_PUT, 0},
+  {&handle_put_batch, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_PUT_BATCH, 0},
   {&handle_update, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_UPDATE,
    sizeof (struct UpdateMessage)},
   {&handle_get, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_GET, 0},
+  {&handle_get_multi, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_GET_MULTI, 0},
   {&handle_get_replication, NULL,
    GNUNET_MESSAGE_TYPE_DATASTORE_GET_REPLICATION,
    sizeof (struct GNUNET_MessageHeader)},
+  {&handle_get_replication_multi, NULL,
+   GNUNET_MESSAGE_TYPE_DATASTORE_GET_REPLICATION_MULTI,
+   sizeof (struct GetReplicationMultiMessage)},
   {&handle_get_zero_anonymity, NULL,
    GNUNET_MESSAGE_TYPE_DATASTORE_GET_ZERO_ANONYMITY,
    sizeof (struct GetZeroAnonymityMessage)},
+  {&handle_get_zero_anonymity_multi, NULL,
+   GNUNET_MESSAGE_TYPE_DATASTORE_GET_ZERO_ANONYMITY_MULTI,
+   sizeof (struct GetZeroAnonymityMultiMessage)},
   {&handle_remove, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_REMOVE, 0},
   {&handle_drop, NULL, GNUNET_MESSAGE_TYPE_DATASTORE_DROP,
    sizeof (struct GNUNET_MessageHeader)},
@@ -1471,6 +1874,28 @@ add_key_to_bloomfilter (void *cls,
 }
 
 
+/**
+ * Task that writes the changes to the (memory-mapped) bloomfilter
+ * to disk.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+sync_bloomfilter (void *cls,
+                  const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  bf_sync_task = NULL;
+  if (GNUNET_OK != GNUNET_CONTAINER_bloomfilter_sync (filter))
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "msync");
+  bf_sync_task
+    = GNUNET_SCHEDULER_add_delayed_with_priority (BF_SYNC_FREQUENCY,
+                                                  GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                  &sync_bloomfilter,
+                                                  NULL);
+}
+
+
 /**
  * We finished receiving the statistic.  Initialize the plugin; if
  * loading the statistic failed, run the estimator.
@@ -1487,6 +1912,11 @@ process_stat_done (void *cls,
   plugin = load_plugin ();
   if (NULL == plugin)
   {
+    if (NULL != bf_sync_task)
+    {
+      GNUNET_SCHEDULER_cancel (bf_sync_task);
+      bf_sync_task = NULL;
+    }
     GNUNET_CONTAINER_bloomfilter_free (filter);
     filter = NULL;
     if (NULL != stats)
@@ -1538,19 +1968,11 @@ static void
 cleaning_task (void *cls,
                const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct TransmitCallbackContext *tcc;
-
   cleaning_done = GNUNET_YES;
-  while (NULL != (tcc = tcc_head))
+  if (NULL != nc)
   {
-    GNUNET_CONTAINER_DLL_remove (tcc_head, tcc_tail, tcc);
-    if (tcc->th != NULL)
-    {
-      GNUNET_SERVER_notify_transmit_ready_cancel (tcc->th);
-      GNUNET_SERVER_client_drop (tcc->client);
-    }
-    GNUNET_free (tcc->msg);
-    GNUNET_free (tcc);
+    GNUNET_SERVER_notification_context_destroy (nc);
+    nc = NULL;
   }
   if (NULL != expired_kill_task)
   {
@@ -1564,8 +1986,14 @@ cleaning_task (void *cls,
     unload_plugin (plugin);
     plugin = NULL;
   }
+  if (NULL != bf_sync_task)
+  {
+    GNUNET_SCHEDULER_cancel (bf_sync_task);
+    bf_sync_task = NULL;
+  }
   if (NULL != filter)
   {
+    GNUNET_break (GNUNET_OK == GNUNET_CONTAINER_bloomfilter_sync (filter));
     GNUNET_CONTAINER_bloomfilter_free (filter);
     filter = NULL;
   }
@@ -1684,6 +2112,7 @@ run (void *cls,
     bf_size = (1 << 31);          /* absolute limit: ~2 GB, beyond that BF just won't help anyway */
   else
     bf_size = quota / (32 * 1024LL);         /* 8 bit per entry, 1 bit per 32 kb in DB */
+  bf_size = (bf_size + 63) & ~63;  /* blocked filters use 64-byte blocks */
   fn = NULL;
   if ((GNUNET_OK !=
        GNUNET_CONFIGURATION_get_value_filename (cfg,
@@ -1700,10 +2129,18 @@ run (void *cls,
   }
   if (NULL != fn)
   {
+    /* files from before we used blocked, memory-mapped filters
+       have a different layout; drop them, the new file will
+       trigger a refresh */
     GNUNET_asprintf (&pfn, "%s.%s", fn, plugin_name);
+    if ( (GNUNET_YES == GNUNET_DISK_file_test (pfn)) &&
+         (0 != UNLINK (pfn)) )
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "unlink", pfn);
+    GNUNET_free (pfn);
+    GNUNET_asprintf (&pfn, "%s.%s.blocked", fn, plugin_name);
     if (GNUNET_YES == GNUNET_DISK_file_test (pfn))
     {
-      filter = GNUNET_CONTAINER_bloomfilter_load (pfn, bf_size, 5);        /* approx. 3% false positives at max use */
+      filter = GNUNET_CONTAINER_bloomfilter_load_mapped (pfn, bf_size, 5, GNUNET_YES);        /* approx. 3% false positives at max use */
       if (NULL == filter)
       {
 	/* file exists but not valid, remove and try again, but refresh */
@@ -1715,13 +2152,13 @@ run (void *cls,
 		      pfn);
 	  GNUNET_free (pfn);
 	  pfn = NULL;
-	  filter = GNUNET_CONTAINER_bloomfilter_load (NULL, bf_size, 5);        /* approx. 3% false positives at max use */
+	  filter = GNUNET_CONTAINER_bloomfilter_init_blocked (NULL, bf_size, 5);        /* approx. 3% false positives at max use */
 	  refresh_bf = GNUNET_YES;
 	}
 	else
 	{
 	  /* try again after remove */
-	  filter = GNUNET_CONTAINER_bloomfilter_load (pfn, bf_size, 5);        /* approx. 3% false positives at max use */
+	  filter = GNUNET_CONTAINER_bloomfilter_load_mapped (pfn, bf_size, 5, GNUNET_YES);        /* approx. 3% false positives at max use */
 	  refresh_bf = GNUNET_YES;
 	  if (NULL == filter)
 	  {
@@ -1731,7 +2168,7 @@ run (void *cls,
 			pfn);
 	    GNUNET_free (pfn);
 	    pfn = NULL;
-	    filter = GNUNET_CONTAINER_bloomfilter_init (NULL, bf_size, 5);        /* approx. 3% false positives at max use */
+	    filter = GNUNET_CONTAINER_bloomfilter_init_blocked (NULL, bf_size, 5);        /* approx. 3% false positives at max use */
 	  }
 	}
       }
@@ -1743,14 +2180,14 @@ run (void *cls,
     }
     else
     {
-      filter = GNUNET_CONTAINER_bloomfilter_load (pfn, bf_size, 5);        /* approx. 3% false positives at max use */
+      filter = GNUNET_CONTAINER_bloomfilter_load_mapped (pfn, bf_size, 5, GNUNET_YES);        /* approx. 3% false positives at max use */
       refresh_bf = GNUNET_YES;
     }
-    GNUNET_free (pfn);
+    GNUNET_free_non_null (pfn);
   }
   else
   {
-    filter = GNUNET_CONTAINER_bloomfilter_init (NULL, bf_size, 5);      /* approx. 3% false positives at max use */
+    filter = GNUNET_CONTAINER_bloomfilter_init_blocked (NULL, bf_size, 5);      /* approx. 3% false positives at max use */
     refresh_bf = GNUNET_YES;
   }
   GNUNET_free_non_null (fn);
@@ -1765,6 +2202,13 @@ run (void *cls,
     }
     return;
   }
+  bf_sync_task
+    = GNUNET_SCHEDULER_add_delayed_with_priority (BF_SYNC_FREQUENCY,
+                                                  GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                  &sync_bloomfilter,
+                                                  NULL);
+  nc = GNUNET_SERVER_notification_context_create (server,
+                                                  MAX_PENDING);
   GNUNET_SERVER_suspend (server);
   stat_get =
       GNUNET_STATISTICS_get (stats,
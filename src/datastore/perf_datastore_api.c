@@ -36,7 +36,7 @@
 #include "gnunet_protocols.h"
 #include "gnunet_datastore_service.h"
 #include "gnunet_testing_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 
 /**
  * How long until we give up on transmitting the message?
@@ -106,6 +106,11 @@ static const char *plugin_name;
  */
 static struct GNUNET_DATASTORE_Handle *datastore;
 
+/**
+ * Benchmark suite we report to.
+ */
+static struct GNUNET_BENCHMARK_Suite *suite;
+
 /**
  * Value we return from #main().
  */
@@ -354,7 +359,6 @@ run_continuation (void *cls,
   size_t size;
   static struct GNUNET_HashCode key;
   static char data[65536];
-  char gstr[128];
 
   if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
     crc->phase = RP_ERROR;
@@ -477,27 +481,12 @@ run_continuation (void *cls,
     break;
 
   case RP_DONE:
-    GNUNET_snprintf (gstr,
-                     sizeof (gstr),
-                     "DATASTORE-%s",
-                     plugin_name);
     if ((crc->i == ITERATIONS) && (stored_ops > 0))
-    {
-      GAUGER (gstr,
-              "PUT operation duration",
-              GNUNET_TIME_absolute_get_duration (start_time).rel_value_us / 1000LL /
-              stored_ops,
-              "ms/operation");
-      fprintf (stdout,
-               "\nPUT performance: %s for %llu operations\n",
-               GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start_time),
-                                                       GNUNET_YES),
-               stored_ops);
-      fprintf (stdout,
-               "PUT performance: %llu ms/operation\n",
-               GNUNET_TIME_absolute_get_duration (start_time).rel_value_us / 1000LL /
-               stored_ops);
-    }
+      GNUNET_BENCHMARK_report (suite,
+                               "PUT operations",
+                               "ops",
+                               GNUNET_TIME_absolute_get_duration (start_time),
+                               stored_ops);
     GNUNET_DATASTORE_disconnect (datastore,
                                  GNUNET_YES);
     GNUNET_free (crc);
@@ -605,8 +594,15 @@ main (int argc,
       char *argv[])
 {
   char cfg_name[128];
+  char gstr[128];
 
   plugin_name = GNUNET_TESTING_get_testname_from_underscore (argv[0]);
+  GNUNET_snprintf (gstr,
+                   sizeof (gstr),
+                   "DATASTORE-%s",
+                   plugin_name);
+  suite = GNUNET_BENCHMARK_suite_create (gstr,
+                                         "perf_datastore_api");
   GNUNET_snprintf (cfg_name,
                    sizeof (cfg_name),
                    "test_datastore_api_data_%s.conf",
@@ -616,8 +612,13 @@ main (int argc,
 			       cfg_name,
 			       &run,
 			       NULL))
+  {
+    GNUNET_BENCHMARK_suite_destroy (suite);
     return 1;
+  }
   FPRINTF (stderr, "%s", "\n");
+  if (GNUNET_OK != GNUNET_BENCHMARK_suite_destroy (suite))
+    return 1;
   return ok;
 }
 
@@ -0,0 +1,1846 @@
+/*
+     This file is part of GNUnet
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file datastore/plugin_datastore_log.c
+ * @brief log-structured datastore backend
+ * @author Christian Grothoff
+ *
+ * Blocks are appended to a sequence of segment files.  Every change
+ * (put, update of priority/expiration/replication, delete) is a
+ * record appended to the newest segment; nothing is ever written in
+ * place.  All metadata lives in memory (organized like in the heap
+ * plugin) and is rebuilt on startup by replaying the record headers
+ * of all segments in order; only the payload stays on disk.
+ *
+ * Space is reclaimed by compacting the oldest segment once less than
+ * #MIN_LIVE_PERCENT of it is still live: its live blocks are copied
+ * to the head of the log (in small steps, at idle priority) and the
+ * segment is unlinked.  Cleaning strictly oldest-first means that an
+ * update or delete record never outlives the put it refers to, so no
+ * tombstones need to be carried forward.
+ */
+
+#include "platform.h"
+#include "gnunet_datastore_plugin.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "datastore-log", __VA_ARGS__)
+
+#define LOG_STRERROR_FILE(kind,op,fn) GNUNET_log_from_strerror_file (kind, "datastore-log", op, fn)
+
+/**
+ * Default maximum size of a segment file.
+ */
+#define DEFAULT_SEGMENT_SIZE (64 * 1024 * 1024)
+
+/**
+ * Compact the oldest segment once less than this percentage
+ * of its bytes belong to live blocks.
+ */
+#define MIN_LIVE_PERCENT 50
+
+/**
+ * How many records do we process per run of the compaction task?
+ */
+#define COMPACT_BATCH 32
+
+/**
+ * Record kind: a new block.
+ */
+#define RECORD_PUT 1
+
+/**
+ * Record kind: new metadata for an existing block.
+ */
+#define RECORD_UPDATE 2
+
+/**
+ * Record kind: a block was removed.
+ */
+#define RECORD_DELETE 3
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of each record in a segment file, all values in network
+ * byte order.  For #RECORD_PUT, @e size bytes of payload follow.
+ */
+struct LogRecord
+{
+  /**
+   * CRC32 over the rest of the header.
+   */
+  uint32_t crc GNUNET_PACKED;
+
+  /**
+   * Kind of the record, one of RECORD_*.
+   */
+  uint32_t kind GNUNET_PACKED;
+
+  /**
+   * Number of payload bytes following the header.
+   */
+  uint32_t size GNUNET_PACKED;
+
+  /**
+   * Type of the block.
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Priority of the block.
+   */
+  uint32_t priority GNUNET_PACKED;
+
+  /**
+   * Anonymity level of the block.
+   */
+  uint32_t anonymity GNUNET_PACKED;
+
+  /**
+   * Replication level of the block.
+   */
+  uint32_t replication GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * Unique identifier of the block.
+   */
+  uint64_t uid GNUNET_PACKED;
+
+  /**
+   * Expiration time of the block.
+   */
+  struct GNUNET_TIME_AbsoluteNBO expiration;
+
+  /**
+   * Key of the block.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Hash of the payload, all zeros for updates and deletes.
+   */
+  struct GNUNET_HashCode vhash;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * A segment file of the log.
+ */
+struct Segment
+{
+  /**
+   * Segments are kept in a DLL, oldest first.
+   */
+  struct Segment *next;
+
+  /**
+   * Segments are kept in a DLL, oldest first.
+   */
+  struct Segment *prev;
+
+  /**
+   * Name of the file.
+   */
+  char *fn;
+
+  /**
+   * Handle to the file.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Number of bytes in the segment.
+   */
+  uint64_t size;
+
+  /**
+   * Number of bytes of put records in this segment whose
+   * block is still live.
+   */
+  uint64_t live;
+
+  /**
+   * Sequence number of the segment (part of @e fn).
+   */
+  uint32_t id;
+};
+
+
+/**
+ * In-memory metadata of a block that we are storing.
+ */
+struct Value
+{
+
+  /**
+   * Key for the value.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Segment with the put record of this block.
+   */
+  struct Segment *segment;
+
+  /**
+   * Entry for this value in the 'expire' heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *expire_heap;
+
+  /**
+   * Entry for this value in the 'replication' heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *replication_heap;
+
+  /**
+   * Unique identifier of the block.
+   */
+  uint64_t uid;
+
+  /**
+   * Expiration time for this value.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Offset of the put record in @e segment.
+   */
+  uint32_t offset;
+
+  /**
+   * Offset of this value in the array of the `struct ZeroAnonByType`;
+   * only used if anonymity is zero.
+   */
+  unsigned int zero_anon_offset;
+
+  /**
+   * Number of bytes of payload.
+   */
+  uint32_t size;
+
+  /**
+   * Priority of the value.
+   */
+  uint32_t priority;
+
+  /**
+   * Anonymity level for the value.
+   */
+  uint32_t anonymity;
+
+  /**
+   * Replication level for the value.
+   */
+  uint32_t replication;
+
+  /**
+   * Type of the payload.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+};
+
+
+/**
+ * We organize 0-anonymity values in arrays "by type".
+ */
+struct ZeroAnonByType
+{
+
+  /**
+   * We keep these in a DLL.
+   */
+  struct ZeroAnonByType *next;
+
+  /**
+   * We keep these in a DLL.
+   */
+  struct ZeroAnonByType *prev;
+
+  /**
+   * Array of 0-anonymity items of the given type.
+   */
+  struct Value **array;
+
+  /**
+   * Allocated size of the array.
+   */
+  unsigned int array_size;
+
+  /**
+   * First unused offset in @e array.
+   */
+  unsigned int array_pos;
+
+  /**
+   * Type of all of the values in @e array.
+   */
+  enum GNUNET_BLOCK_Type type;
+};
+
+
+/**
+ * Context for all functions in this plugin.
+ */
+struct Plugin
+{
+  /**
+   * Our execution environment.
+   */
+  struct GNUNET_DATASTORE_PluginEnvironment *env;
+
+  /**
+   * Directory with the segment files.
+   */
+  char *dir;
+
+  /**
+   * Oldest segment.
+   */
+  struct Segment *seg_head;
+
+  /**
+   * Newest segment, the one we append to.
+   */
+  struct Segment *seg_tail;
+
+  /**
+   * Mapping from keys to `struct Value`s.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *keyvalue;
+
+  /**
+   * Mapping from (the lower 32 bits of) uids to `struct Value`s.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *by_uid;
+
+  /**
+   * Heap organized by minimum expiration time.
+   */
+  struct GNUNET_CONTAINER_Heap *by_expiration;
+
+  /**
+   * Heap organized by maximum replication value.
+   */
+  struct GNUNET_CONTAINER_Heap *by_replication;
+
+  /**
+   * Head of list of arrays containing zero-anonymity values by type.
+   */
+  struct ZeroAnonByType *zero_head;
+
+  /**
+   * Tail of list of arrays containing zero-anonymity values by type.
+   */
+  struct ZeroAnonByType *zero_tail;
+
+  /**
+   * Task compacting the oldest segment, NULL if not running.
+   */
+  struct GNUNET_SCHEDULER_Task *compact_task;
+
+  /**
+   * Position of the compaction within the oldest segment.
+   */
+  uint64_t compact_pos;
+
+  /**
+   * Total size of all segment files.
+   */
+  unsigned long long disk_size;
+
+  /**
+   * Maximum size of a segment.
+   */
+  unsigned long long segment_size;
+
+  /**
+   * Next unique identifier to assign.
+   */
+  uint64_t next_uid;
+
+  /**
+   * Should the database be dropped on shutdown?
+   */
+  int drop_on_shutdown;
+
+};
+
+
+/**
+ * Get an estimate of how much space the database is
+ * currently using.
+ *
+ * @param cls our `struct Plugin *`
+ * @param[out] estimate set to the number of bytes used on disk
+ */
+static void
+log_plugin_estimate_size (void *cls,
+                          unsigned long long *estimate)
+{
+  struct Plugin *plugin = cls;
+
+  if (NULL != estimate)
+    *estimate = plugin->disk_size;
+}
+
+
+/**
+ * Compute the checksum of a record header.
+ *
+ * @param rec record to checksum
+ * @return checksum in network byte order
+ */
+static uint32_t
+record_crc (const struct LogRecord *rec)
+{
+  return htonl ((uint32_t) GNUNET_CRYPTO_crc32_n (&rec->kind,
+                                                  sizeof (struct LogRecord) -
+                                                  sizeof (uint32_t)));
+}
+
+
+/**
+ * Fill in a record header from the metadata of a value.
+ *
+ * @param kind record kind
+ * @param value value to describe
+ * @param[out] rec record to initialize (checksum included)
+ */
+static void
+make_record (uint32_t kind,
+             const struct Value *value,
+             struct LogRecord *rec)
+{
+  memset (rec, 0, sizeof (struct LogRecord));
+  rec->kind = htonl (kind);
+  rec->type = htonl ((uint32_t) value->type);
+  rec->priority = htonl (value->priority);
+  rec->anonymity = htonl (value->anonymity);
+  rec->replication = htonl (value->replication);
+  rec->uid = GNUNET_htonll (value->uid);
+  rec->expiration = GNUNET_TIME_absolute_hton (value->expiration);
+  rec->key = value->key;
+}
+
+
+/**
+ * Read from a segment.
+ *
+ * @param seg segment to read from
+ * @param offset where to start reading
+ * @param buf where to store the data
+ * @param len number of bytes to read
+ * @return #GNUNET_OK on success
+ */
+static int
+segment_read (struct Segment *seg,
+              uint64_t offset,
+              void *buf,
+              size_t len)
+{
+  if ( (offset != (uint64_t) GNUNET_DISK_file_seek (seg->fh,
+                                                    (off_t) offset,
+                                                    GNUNET_DISK_SEEK_SET)) ||
+       (len != GNUNET_DISK_file_read (seg->fh,
+                                      buf,
+                                      len)) )
+  {
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_ERROR,
+                       "read",
+                       seg->fn);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Open (and possibly create) a segment file and append it
+ * to the list of segments.
+ *
+ * @param plugin our plugin
+ * @param id sequence number of the segment
+ * @return the segment, NULL on error
+ */
+static struct Segment *
+segment_open (struct Plugin *plugin,
+              uint32_t id)
+{
+  struct Segment *seg;
+  off_t size;
+
+  seg = GNUNET_new (struct Segment);
+  seg->id = id;
+  GNUNET_asprintf (&seg->fn,
+                   "%s%s%08u.seg",
+                   plugin->dir,
+                   DIR_SEPARATOR_STR,
+                   (unsigned int) id);
+  seg->fh = GNUNET_DISK_file_open (seg->fn,
+                                   GNUNET_DISK_OPEN_READWRITE |
+                                   GNUNET_DISK_OPEN_CREATE,
+                                   GNUNET_DISK_PERM_USER_READ |
+                                   GNUNET_DISK_PERM_USER_WRITE);
+  if ( (NULL == seg->fh) ||
+       (GNUNET_OK != GNUNET_DISK_file_handle_size (seg->fh,
+                                                   &size)) )
+  {
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_ERROR,
+                       "open",
+                       seg->fn);
+    if (NULL != seg->fh)
+      GNUNET_DISK_file_close (seg->fh);
+    GNUNET_free (seg->fn);
+    GNUNET_free (seg);
+    return NULL;
+  }
+  seg->size = size;
+  plugin->disk_size += size;
+  GNUNET_CONTAINER_DLL_insert_tail (plugin->seg_head,
+                                    plugin->seg_tail,
+                                    seg);
+  return seg;
+}
+
+
+/**
+ * Close a segment and remove it from the list.
+ *
+ * @param plugin our plugin
+ * @param seg segment to close
+ * @param do_unlink #GNUNET_YES to also remove the file
+ */
+static void
+segment_close (struct Plugin *plugin,
+               struct Segment *seg,
+               int do_unlink)
+{
+  GNUNET_CONTAINER_DLL_remove (plugin->seg_head,
+                               plugin->seg_tail,
+                               seg);
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (seg->fh));
+  if ( (GNUNET_YES == do_unlink) &&
+       (0 != UNLINK (seg->fn)) )
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "unlink",
+                       seg->fn);
+  plugin->disk_size -= seg->size;
+  GNUNET_free (seg->fn);
+  GNUNET_free (seg);
+}
+
+
+/**
+ * Append a record to the head of the log, starting a new segment
+ * if the current one is full.
+ *
+ * @param plugin our plugin
+ * @param rec record header, checksum is filled in here
+ * @param data payload, NULL if @a rec has none
+ * @param[out] seg set to the segment the record was written to, can be NULL
+ * @param[out] offset set to the offset of the record, can be NULL
+ * @return #GNUNET_OK on success
+ */
+static int
+append_record (struct Plugin *plugin,
+               struct LogRecord *rec,
+               const void *data,
+               struct Segment **seg,
+               uint32_t *offset)
+{
+  struct Segment *head;
+  uint32_t size;
+  size_t total;
+  char *buf;
+
+  size = ntohl (rec->size);
+  total = sizeof (struct LogRecord) + size;
+  head = plugin->seg_tail;
+  if ( (NULL == head) ||
+       ( (head->size > 0) &&
+         (head->size + total > plugin->segment_size) ) )
+  {
+    head = segment_open (plugin,
+                         (NULL == head) ? 0 : head->id + 1);
+    if (NULL == head)
+      return GNUNET_SYSERR;
+  }
+  rec->crc = record_crc (rec);
+  buf = GNUNET_malloc (total);
+  memcpy (buf, rec, sizeof (struct LogRecord));
+  if (0 != size)
+    memcpy (&buf[sizeof (struct LogRecord)], data, size);
+  if ( (head->size != (uint64_t) GNUNET_DISK_file_seek (head->fh,
+                                                        (off_t) head->size,
+                                                        GNUNET_DISK_SEEK_SET)) ||
+       (total != GNUNET_DISK_file_write (head->fh,
+                                         buf,
+                                         total)) )
+  {
+    /* a partial record is overwritten by the next append */
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_ERROR,
+                       "write",
+                       head->fn);
+    GNUNET_free (buf);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (buf);
+  if (NULL != seg)
+    *seg = head;
+  if (NULL != offset)
+    *offset = (uint32_t) head->size;
+  head->size += total;
+  plugin->disk_size += total;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Closure for #find_uid().
+ */
+struct UidContext
+{
+  /**
+   * Unique identifier we are looking for.
+   */
+  uint64_t uid;
+
+  /**
+   * Set to the value with @e uid.
+   */
+  struct Value *value;
+};
+
+
+/**
+ * Check if a value has the uid we are looking for.
+ *
+ * @param cls the `struct UidContext`
+ * @param key lower 32 bits of the uid
+ * @param val a `struct Value`
+ * @return #GNUNET_NO if found
+ */
+static int
+find_uid (void *cls,
+          uint32_t key,
+          void *val)
+{
+  struct UidContext *uc = cls;
+  struct Value *value = val;
+
+  if (value->uid != uc->uid)
+    return GNUNET_YES;
+  uc->value = value;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Find the value with a given unique identifier.
+ *
+ * @param plugin our plugin
+ * @param uid identifier to look up
+ * @return NULL if not found
+ */
+static struct Value *
+lookup_uid (struct Plugin *plugin,
+            uint64_t uid)
+{
+  struct UidContext uc;
+
+  uc.uid = uid;
+  uc.value = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (plugin->by_uid,
+                                                (uint32_t) uid,
+                                                &find_uid,
+                                                &uc);
+  return uc.value;
+}
+
+
+/**
+ * Add a value to the in-memory indices.
+ *
+ * @param plugin our plugin
+ * @param value value to index
+ */
+static void
+index_value (struct Plugin *plugin,
+             struct Value *value)
+{
+  value->expire_heap = GNUNET_CONTAINER_heap_insert (plugin->by_expiration,
+						     value,
+						     value->expiration.abs_value_us);
+  value->replication_heap = GNUNET_CONTAINER_heap_insert (plugin->by_replication,
+							  value,
+							  value->replication);
+  if (0 == value->anonymity)
+  {
+    struct ZeroAnonByType *zabt;
+
+    for (zabt = plugin->zero_head; NULL != zabt; zabt = zabt->next)
+      if (zabt->type == value->type)
+	break;
+    if (NULL == zabt)
+    {
+      zabt = GNUNET_new (struct ZeroAnonByType);
+      zabt->type = value->type;
+      GNUNET_CONTAINER_DLL_insert (plugin->zero_head,
+				   plugin->zero_tail,
+				   zabt);
+    }
+    if (zabt->array_size == zabt->array_pos)
+    {
+      GNUNET_array_grow (zabt->array,
+			 zabt->array_size,
+			 zabt->array_size * 2 + 4);
+    }
+    value->zero_anon_offset = zabt->array_pos;
+    zabt->array[zabt->array_pos++] = value;
+  }
+  GNUNET_CONTAINER_multihashmap_put (plugin->keyvalue,
+				     &value->key,
+				     value,
+				     GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  GNUNET_CONTAINER_multihashmap32_put (plugin->by_uid,
+                                       (uint32_t) value->uid,
+                                       value,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  value->segment->live += sizeof (struct LogRecord) + value->size;
+}
+
+
+/**
+ * Remove a value from the in-memory indices and free it.
+ *
+ * @param plugin our plugin
+ * @param value value to forget
+ */
+static void
+forget_value (struct Plugin *plugin,
+              struct Value *value)
+{
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (plugin->keyvalue,
+						       &value->key,
+						       value));
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap32_remove (plugin->by_uid,
+                                                         (uint32_t) value->uid,
+                                                         value));
+  GNUNET_assert (value == GNUNET_CONTAINER_heap_remove_node (value->expire_heap));
+  GNUNET_assert (value == GNUNET_CONTAINER_heap_remove_node (value->replication_heap));
+  if (0 == value->anonymity)
+  {
+    struct ZeroAnonByType *zabt;
+
+    for (zabt = plugin->zero_head; NULL != zabt; zabt = zabt->next)
+      if (zabt->type == value->type)
+	break;
+    GNUNET_assert (NULL != zabt);
+    zabt->array[value->zero_anon_offset] = zabt->array[--zabt->array_pos];
+    zabt->array[value->zero_anon_offset]->zero_anon_offset = value->zero_anon_offset;
+    if (0 == zabt->array_pos)
+    {
+      GNUNET_array_grow (zabt->array,
+			 zabt->array_size,
+			 0);
+      GNUNET_CONTAINER_DLL_remove (plugin->zero_head,
+				   plugin->zero_tail,
+				   zabt);
+      GNUNET_free (zabt);
+    }
+  }
+  value->segment->live -= sizeof (struct LogRecord) + value->size;
+  GNUNET_free (value);
+}
+
+
+/**
+ * Task copying the live blocks of the oldest segment to the head
+ * of the log, a few at a time, and unlinking the segment once done.
+ *
+ * @param cls our `struct Plugin`
+ * @param tc scheduler context
+ */
+static void
+compact_task_cb (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Start compacting the oldest segment if enough of it is garbage.
+ *
+ * @param plugin our plugin
+ */
+static void
+check_compaction (struct Plugin *plugin)
+{
+  struct Segment *oldest = plugin->seg_head;
+
+  if ( (NULL != plugin->compact_task) ||
+       (NULL == oldest) ||
+       (oldest == plugin->seg_tail) ||
+       (oldest->live * 100 >= oldest->size * MIN_LIVE_PERCENT) )
+    return;
+  plugin->compact_pos = 0;
+  plugin->compact_task
+    = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                          &compact_task_cb,
+                                          plugin);
+}
+
+
+/**
+ * Task copying the live blocks of the oldest segment to the head
+ * of the log, a few at a time, and unlinking the segment once done.
+ *
+ * @param cls our `struct Plugin`
+ * @param tc scheduler context
+ */
+static void
+compact_task_cb (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Plugin *plugin = cls;
+  struct Segment *oldest = plugin->seg_head;
+  struct LogRecord rec;
+  struct Value *value;
+  struct Segment *seg;
+  uint32_t offset;
+  uint32_t size;
+  unsigned int i;
+  char *data;
+
+  plugin->compact_task = NULL;
+  for (i = 0; i < COMPACT_BATCH; i++)
+  {
+    if ( (0 == oldest->live) ||
+         (plugin->compact_pos >= oldest->size) )
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Removing compacted segment `%s'\n",
+           oldest->fn);
+      segment_close (plugin, oldest, GNUNET_YES);
+      check_compaction (plugin);
+      return;
+    }
+    if (GNUNET_OK != segment_read (oldest,
+                                   plugin->compact_pos,
+                                   &rec,
+                                   sizeof (rec)))
+      return;
+    size = ntohl (rec.size);
+    offset = (uint32_t) plugin->compact_pos;
+    plugin->compact_pos += sizeof (rec) + size;
+    if (RECORD_PUT != ntohl (rec.kind))
+      continue;
+    value = lookup_uid (plugin,
+                        GNUNET_ntohll (rec.uid));
+    if ( (NULL == value) ||
+         (value->segment != oldest) ||
+         (value->offset != offset) )
+      continue;
+    /* copy the block with its current metadata */
+    data = GNUNET_malloc (size);
+    if (GNUNET_OK != segment_read (oldest,
+                                   offset + sizeof (rec),
+                                   data,
+                                   size))
+    {
+      GNUNET_free (data);
+      return;
+    }
+    make_record (RECORD_PUT, value, &rec);
+    rec.size = htonl (size);
+    GNUNET_CRYPTO_hash (data, size, &rec.vhash);
+    if (GNUNET_OK != append_record (plugin,
+                                    &rec,
+                                    data,
+                                    &seg,
+                                    &offset))
+    {
+      GNUNET_free (data);
+      return;
+    }
+    GNUNET_free (data);
+    oldest->live -= sizeof (rec) + size;
+    value->segment = seg;
+    value->offset = offset;
+    seg->live += sizeof (rec) + size;
+  }
+  plugin->compact_task
+    = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                          &compact_task_cb,
+                                          plugin);
+}
+
+
+/**
+ * Delete the given value: log the deletion and remove it from the
+ * plugin's data structures.
+ *
+ * @param plugin the plugin
+ * @param value value to delete
+ */
+static void
+delete_value (struct Plugin *plugin,
+	      struct Value *value)
+{
+  struct LogRecord rec;
+
+  make_record (RECORD_DELETE, value, &rec);
+  if (GNUNET_OK != append_record (plugin, &rec, NULL, NULL, NULL))
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Failed to log deletion, block will reappear after restart\n"));
+  forget_value (plugin, value);
+  check_compaction (plugin);
+}
+
+
+/**
+ * Log the current metadata of a value.
+ *
+ * @param plugin the plugin
+ * @param value value that changed
+ * @return #GNUNET_OK on success
+ */
+static int
+log_update (struct Plugin *plugin,
+            struct Value *value)
+{
+  struct LogRecord rec;
+
+  make_record (RECORD_UPDATE, value, &rec);
+  return append_record (plugin, &rec, NULL, NULL, NULL);
+}
+
+
+/**
+ * Read the payload of a value and pass it to @a proc; delete the
+ * value if @a proc asks for it.
+ *
+ * @param plugin the plugin
+ * @param value value to return
+ * @param proc function to call
+ * @param proc_cls closure for @a proc
+ */
+static void
+return_value (struct Plugin *plugin,
+              struct Value *value,
+              PluginDatumProcessor proc,
+              void *proc_cls)
+{
+  char *data;
+
+  data = GNUNET_malloc (value->size);
+  if (GNUNET_OK != segment_read (value->segment,
+                                 value->offset + sizeof (struct LogRecord),
+                                 data,
+                                 value->size))
+  {
+    GNUNET_free (data);
+    proc (proc_cls,
+	  NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
+    return;
+  }
+  if (GNUNET_NO ==
+      proc (proc_cls,
+	    &value->key,
+	    value->size,
+	    data,
+	    value->type,
+	    value->priority,
+	    value->anonymity,
+	    value->expiration,
+	    value->uid))
+    delete_value (plugin, value);
+  GNUNET_free (data);
+}
+
+
+/**
+ * Store an item in the datastore.
+ *
+ * @param cls closure
+ * @param key key for the item
+ * @param size number of bytes in @a data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param replication replication-level for the content
+ * @param expiration expiration time for the content
+ * @param cont continuation called with success or failure status
+ * @param cont_cls continuation closure
+ */
+static void
+log_plugin_put (void *cls,
+                const struct GNUNET_HashCode *key,
+                uint32_t size,
+                const void *data,
+                enum GNUNET_BLOCK_Type type,
+                uint32_t priority,
+                uint32_t anonymity,
+                uint32_t replication,
+                struct GNUNET_TIME_Absolute expiration,
+                PluginPutCont cont,
+                void *cont_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Value *value;
+  struct LogRecord rec;
+
+  value = GNUNET_new (struct Value);
+  value->key = *key;
+  value->uid = plugin->next_uid;
+  value->expiration = expiration;
+  value->size = size;
+  value->priority = priority;
+  value->anonymity = anonymity;
+  value->replication = replication;
+  value->type = type;
+  make_record (RECORD_PUT, value, &rec);
+  rec.size = htonl (size);
+  GNUNET_CRYPTO_hash (data, size, &rec.vhash);
+  if (GNUNET_OK != append_record (plugin,
+                                  &rec,
+                                  data,
+                                  &value->segment,
+                                  &value->offset))
+  {
+    GNUNET_free (value);
+    cont (cont_cls, key, size, GNUNET_SYSERR, _("Failed to append to log"));
+    return;
+  }
+  plugin->next_uid++;
+  index_value (plugin, value);
+  cont (cont_cls, key, size, GNUNET_OK, NULL);
+}
+
+
+/**
+ * Closure for iterator called during 'get_key'.
+ */
+struct GetContext
+{
+
+  /**
+   * Desired result offset / number of results.
+   */
+  uint64_t offset;
+
+  /**
+   * The plugin.
+   */
+  struct Plugin *plugin;
+
+  /**
+   * Requested value hash.
+   */
+  const struct GNUNET_HashCode * vhash;
+
+  /**
+   * Requested type.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Value found at the desired offset.
+   */
+  struct Value *value;
+};
+
+
+/**
+ * Test if a value matches the specification from the 'get' context
+ *
+ * @param gc query
+ * @param value the value to check against the query
+ * @return #GNUNET_YES if the value matches
+ */
+static int
+match (const struct GetContext *gc,
+       struct Value *value)
+{
+  struct LogRecord rec;
+
+  if ( (gc->type != GNUNET_BLOCK_TYPE_ANY) &&
+       (gc->type != value->type) )
+    return GNUNET_NO;
+  if (NULL != gc->vhash)
+  {
+    /* the payload hash is in the put record on disk */
+    if ( (GNUNET_OK != segment_read (value->segment,
+                                     value->offset,
+                                     &rec,
+                                     sizeof (rec))) ||
+         (0 != memcmp (&rec.vhash,
+                       gc->vhash,
+                       sizeof (struct GNUNET_HashCode))) )
+      return GNUNET_NO;
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Count number of matching values.
+ *
+ * @param cls the `struct GetContext`
+ * @param key unused
+ * @param val the `struct Value`
+ * @return #GNUNET_YES (continue iteration)
+ */
+static int
+count_iterator (void *cls,
+		const struct GNUNET_HashCode *key,
+		void *val)
+{
+  struct GetContext *gc = cls;
+  struct Value *value = val;
+
+  if (GNUNET_NO == match (gc, value))
+    return GNUNET_OK;
+  gc->offset++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Find matching value at 'offset'.
+ *
+ * @param cls the `struct GetContext`
+ * @param key unused
+ * @param val the `struct Value`
+ * @return #GNUNET_YES (continue iteration), #GNUNET_NO if result was found
+ */
+static int
+get_iterator (void *cls,
+	      const struct GNUNET_HashCode *key,
+	      void *val)
+{
+  struct GetContext *gc = cls;
+  struct Value *value = val;
+
+  if (GNUNET_NO == match (gc, value))
+    return GNUNET_OK;
+  if (0 != gc->offset--)
+    return GNUNET_OK;
+  gc->value = value;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Get one of the results for a particular key in the datastore.
+ *
+ * @param cls closure
+ * @param offset offset of the result (modulo num-results);
+ *               specific ordering does not matter for the offset
+ * @param key maybe NULL (to match all entries)
+ * @param vhash hash of the value, maybe NULL (to
+ *        match all values that have the right key).
+ *        Note that for DBlocks there is no difference
+ *        betwen key and vhash, but for other blocks
+ *        there may be!
+ * @param type entries of which type are relevant?
+ *     Use 0 for any type.
+ * @param proc function to call on each matching value;
+ *        will be called with NULL if nothing matches
+ * @param proc_cls closure for @a proc
+ */
+static void
+log_plugin_get_key (void *cls,
+                    uint64_t offset,
+                    const struct GNUNET_HashCode *key,
+                    const struct GNUNET_HashCode *vhash,
+                    enum GNUNET_BLOCK_Type type,
+                    PluginDatumProcessor proc,
+                    void *proc_cls)
+{
+  struct Plugin *plugin = cls;
+  struct GetContext gc;
+
+  gc.plugin = plugin;
+  gc.offset = 0;
+  gc.vhash = vhash;
+  gc.type = type;
+  gc.value = NULL;
+  if (NULL == key)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->keyvalue,
+					   &count_iterator,
+					   &gc);
+    if (0 != gc.offset)
+    {
+      gc.offset = offset % gc.offset;
+      GNUNET_CONTAINER_multihashmap_iterate (plugin->keyvalue,
+                                             &get_iterator,
+                                             &gc);
+    }
+  }
+  else
+  {
+    GNUNET_CONTAINER_multihashmap_get_multiple (plugin->keyvalue,
+						key,
+						&count_iterator,
+						&gc);
+    if (0 != gc.offset)
+    {
+      gc.offset = offset % gc.offset;
+      GNUNET_CONTAINER_multihashmap_get_multiple (plugin->keyvalue,
+                                                  key,
+                                                  &get_iterator,
+                                                  &gc);
+    }
+  }
+  if (NULL == gc.value)
+  {
+    proc (proc_cls,
+	  NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
+    return;
+  }
+  return_value (plugin, gc.value, proc, proc_cls);
+}
+
+
+/**
+ * Get a random item for replication.  Returns a single, not expired,
+ * random item from those with the highest replication counters.  The
+ * item's replication counter is decremented by one IF it was positive
+ * before.  Call @a proc with all values ZERO or NULL if the datastore
+ * is empty.
+ *
+ * @param cls closure
+ * @param proc function to call the value (once only).
+ * @param proc_cls closure for @a proc
+ */
+static void
+log_plugin_get_replication (void *cls,
+                            PluginDatumProcessor proc,
+                            void *proc_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Value *value;
+
+  value = GNUNET_CONTAINER_heap_remove_root (plugin->by_replication);
+  if (NULL == value)
+  {
+    proc (proc_cls,
+	  NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
+    return;
+  }
+  if (value->replication > 0)
+  {
+    value->replication--;
+    value->replication_heap = GNUNET_CONTAINER_heap_insert (plugin->by_replication,
+							    value,
+							    value->replication);
+    (void) log_update (plugin, value);
+  }
+  else
+  {
+    /* need a better way to pick a random item, replication level is always 0 */
+    value->replication_heap = GNUNET_CONTAINER_heap_insert (plugin->by_replication,
+							    value,
+							    value->replication);
+    value = GNUNET_CONTAINER_heap_walk_get_next (plugin->by_replication);
+  }
+  return_value (plugin, value, proc, proc_cls);
+}
+
+
+/**
+ * Get a random item for expiration.  Call @a proc with all values
+ * ZERO or NULL if the datastore is empty.
+ *
+ * @param cls closure
+ * @param proc function to call the value (once only).
+ * @param proc_cls closure for @a proc
+ */
+static void
+log_plugin_get_expiration (void *cls,
+                           PluginDatumProcessor proc,
+                           void *proc_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Value *value;
+
+  value = GNUNET_CONTAINER_heap_peek (plugin->by_expiration);
+  if (NULL == value)
+  {
+    proc (proc_cls,
+	  NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
+    return;
+  }
+  return_value (plugin, value, proc, proc_cls);
+}
+
+
+/**
+ * Update the priority for a particular key in the datastore.  If
+ * the expiration time in value is different than the time found in
+ * the datastore, the higher value should be kept.  For the
+ * anonymity level, the lower value is to be used.  The specified
+ * priority should be added to the existing priority, ignoring the
+ * priority in value.
+ *
+ * @param cls our `struct Plugin *`
+ * @param uid unique identifier of the datum
+ * @param delta by how much should the priority
+ *     change?  If priority + delta < 0 the
+ *     priority should be set to 0 (never go
+ *     negative).
+ * @param expire new expiration time should be the
+ *     MAX of any existing expiration time and
+ *     this value
+ * @param cont continuation called with success or failure status
+ * @param cons_cls continuation closure
+ */
+static void
+log_plugin_update (void *cls,
+                   uint64_t uid,
+                   int delta,
+                   struct GNUNET_TIME_Absolute expire,
+                   PluginUpdateCont cont,
+                   void *cont_cls)
+{
+  struct Plugin *plugin = cls;
+  struct Value *value;
+
+  value = lookup_uid (plugin, uid);
+  if (NULL == value)
+  {
+    cont (cont_cls, GNUNET_SYSERR, _("Unknown unique identifier"));
+    return;
+  }
+  if (value->expiration.abs_value_us < expire.abs_value_us)
+  {
+    value->expiration = expire;
+    GNUNET_CONTAINER_heap_update_cost (plugin->by_expiration,
+				       value->expire_heap,
+				       expire.abs_value_us);
+  }
+  if ( (delta < 0) && (value->priority < - delta) )
+    value->priority = 0;
+  else
+    value->priority += delta;
+  if (GNUNET_OK != log_update (plugin, value))
+  {
+    cont (cont_cls, GNUNET_SYSERR, _("Failed to append to log"));
+    return;
+  }
+  cont (cont_cls, GNUNET_OK, NULL);
+}
+
+
+/**
+ * Call the given processor on an item with zero anonymity.
+ *
+ * @param cls our `struct Plugin *`
+ * @param offset offset of the result (modulo num-results);
+ *               specific ordering does not matter for the offset
+ * @param type entries of which type should be considered?
+ *        Use 0 for any type.
+ * @param proc function to call on each matching value;
+ *        will be called  with NULL if no value matches
+ * @param proc_cls closure for @a proc
+ */
+static void
+log_plugin_get_zero_anonymity (void *cls,
+                               uint64_t offset,
+                               enum GNUNET_BLOCK_Type type,
+                               PluginDatumProcessor proc,
+                               void *proc_cls)
+{
+  struct Plugin *plugin = cls;
+  struct ZeroAnonByType *zabt;
+  uint64_t count;
+
+  count = 0;
+  for (zabt = plugin->zero_head; NULL != zabt; zabt = zabt->next)
+  {
+    if ( (type != GNUNET_BLOCK_TYPE_ANY) &&
+	 (type != zabt->type) )
+      continue;
+    count += zabt->array_pos;
+  }
+  if (0 == count)
+  {
+    proc (proc_cls,
+	  NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
+    return;
+  }
+  offset = offset % count;
+  for (zabt = plugin->zero_head; NULL != zabt; zabt = zabt->next)
+  {
+    if ( (type != GNUNET_BLOCK_TYPE_ANY) &&
+	 (type != zabt->type) )
+      continue;
+    if (offset >= zabt->array_pos)
+    {
+      offset -= zabt->array_pos;
+      continue;
+    }
+    break;
+  }
+  GNUNET_assert (NULL != zabt);
+  return_value (plugin, zabt->array[offset], proc, proc_cls);
+}
+
+
+/**
+ * Drop database.
+ *
+ * @param cls our `struct Plugin *`
+ */
+static void
+log_plugin_drop (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->drop_on_shutdown = GNUNET_YES;
+}
+
+
+/**
+ * Closure for #return_key().
+ */
+struct GetAllContext
+{
+  /**
+   * Function to call.
+   */
+  PluginKeyProcessor proc;
+
+  /**
+   * Closure for @e proc.
+   */
+  void *proc_cls;
+};
+
+
+/**
+ * Callback invoked to call callback on each value.
+ *
+ * @param cls the `struct GetAllContext`
+ * @param key key of the value
+ * @param val the value
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+return_key (void *cls,
+            const struct GNUNET_HashCode *key,
+            void *val)
+{
+  struct GetAllContext *gac = cls;
+
+  gac->proc (gac->proc_cls,
+	     key,
+	     1);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Get all of the keys in the datastore.
+ *
+ * @param cls closure
+ * @param proc function to call on each key
+ * @param proc_cls closure for @a proc
+ */
+static void
+log_get_keys (void *cls,
+              PluginKeyProcessor proc,
+              void *proc_cls)
+{
+  struct Plugin *plugin = cls;
+  struct GetAllContext gac;
+
+  gac.proc = proc;
+  gac.proc_cls = proc_cls;
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->keyvalue,
+					 &return_key,
+					 &gac);
+  proc (proc_cls, NULL, 0);
+}
+
+
+/**
+ * Apply one record found while replaying the log.
+ *
+ * @param plugin our plugin
+ * @param seg segment containing the record
+ * @param offset offset of the record in @a seg
+ * @param rec the record
+ */
+static void
+replay_record (struct Plugin *plugin,
+               struct Segment *seg,
+               uint32_t offset,
+               const struct LogRecord *rec)
+{
+  struct Value *value;
+  uint64_t uid;
+
+  uid = GNUNET_ntohll (rec->uid);
+  if (uid >= plugin->next_uid)
+    plugin->next_uid = uid + 1;
+  value = lookup_uid (plugin, uid);
+  switch (ntohl (rec->kind))
+  {
+  case RECORD_PUT:
+    if (NULL != value)
+      forget_value (plugin, value); /* superseded by a compacted copy */
+    value = GNUNET_new (struct Value);
+    value->key = rec->key;
+    value->segment = seg;
+    value->offset = offset;
+    value->uid = uid;
+    value->expiration = GNUNET_TIME_absolute_ntoh (rec->expiration);
+    value->size = ntohl (rec->size);
+    value->priority = ntohl (rec->priority);
+    value->anonymity = ntohl (rec->anonymity);
+    value->replication = ntohl (rec->replication);
+    value->type = (enum GNUNET_BLOCK_Type) ntohl (rec->type);
+    index_value (plugin, value);
+    break;
+  case RECORD_UPDATE:
+    /* updates of blocks that were moved by compaction are stale */
+    if (NULL == value)
+      break;
+    value->priority = ntohl (rec->priority);
+    value->replication = ntohl (rec->replication);
+    value->expiration = GNUNET_TIME_absolute_ntoh (rec->expiration);
+    GNUNET_CONTAINER_heap_update_cost (plugin->by_expiration,
+                                       value->expire_heap,
+                                       value->expiration.abs_value_us);
+    GNUNET_CONTAINER_heap_update_cost (plugin->by_replication,
+                                       value->replication_heap,
+                                       value->replication);
+    break;
+  case RECORD_DELETE:
+    if (NULL != value)
+      forget_value (plugin, value);
+    break;
+  default:
+    GNUNET_break (0);
+    break;
+  }
+}
+
+
+/**
+ * Replay all records of a segment.  A damaged record ends the
+ * segment; if this is the newest segment, the damaged tail is cut
+ * off so that new records can be appended.
+ *
+ * @param plugin our plugin
+ * @param seg segment to replay
+ */
+static void
+replay_segment (struct Plugin *plugin,
+                struct Segment *seg)
+{
+  struct LogRecord rec;
+  uint64_t offset;
+  uint32_t size;
+
+  offset = 0;
+  while (offset + sizeof (rec) <= seg->size)
+  {
+    if (GNUNET_OK != segment_read (seg, offset, &rec, sizeof (rec)))
+      break;
+    size = ntohl (rec.size);
+    if ( (rec.crc != record_crc (&rec)) ||
+         (offset + sizeof (rec) + size > seg->size) )
+      break;
+    replay_record (plugin, seg, (uint32_t) offset, &rec);
+    offset += sizeof (rec) + size;
+  }
+  if (offset == seg->size)
+    return;
+  LOG (GNUNET_ERROR_TYPE_WARNING,
+       _("Segment `%s' is damaged after %llu bytes\n"),
+       seg->fn,
+       (unsigned long long) offset);
+  if (seg != plugin->seg_tail)
+    return;
+  if (0 != TRUNCATE (seg->fn, (off_t) offset))
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "truncate",
+                       seg->fn);
+  plugin->disk_size -= seg->size - offset;
+  seg->size = offset;
+}
+
+
+/**
+ * Closure for #scan_segment().
+ */
+struct ScanContext
+{
+  /**
+   * Array of segment ids found.
+   */
+  uint32_t *ids;
+
+  /**
+   * Number of entries in @e ids.
+   */
+  unsigned int ids_len;
+};
+
+
+/**
+ * Remember the id of a segment file in the log directory.
+ *
+ * @param cls the `struct ScanContext`
+ * @param filename full name of the file
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+scan_segment (void *cls,
+              const char *filename)
+{
+  struct ScanContext *sc = cls;
+  const char *base;
+
+  base = strrchr (filename, DIR_SEPARATOR);
+  base = (NULL == base) ? filename : base + 1;
+  if ( (8 != strspn (base, "0123456789")) ||
+       (0 != strcmp (&base[8], ".seg")) )
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Ignoring `%s' in log directory\n",
+         filename);
+    return GNUNET_OK;
+  }
+  GNUNET_array_append (sc->ids,
+                       sc->ids_len,
+                       (uint32_t) strtoul (base, NULL, 10));
+  return GNUNET_OK;
+}
+
+
+/**
+ * Compare two segment ids for qsort().
+ *
+ * @param a first id
+ * @param b second id
+ * @return -1, 0 or 1
+ */
+static int
+cmp_ids (const void *a,
+         const void *b)
+{
+  uint32_t ia = *(const uint32_t *) a;
+  uint32_t ib = *(const uint32_t *) b;
+
+  if (ia < ib)
+    return -1;
+  if (ia > ib)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Entry point for the plugin.
+ *
+ * @param cls the `struct GNUNET_DATASTORE_PluginEnvironment *`
+ * @return our `struct GNUNET_DATASTORE_PluginFunctions *`
+ */
+void *
+libgnunet_plugin_datastore_log_init (void *cls)
+{
+  struct GNUNET_DATASTORE_PluginEnvironment *env = cls;
+  struct GNUNET_DATASTORE_PluginFunctions *api;
+  struct Plugin *plugin;
+  struct ScanContext sc;
+  struct Segment *seg;
+  unsigned long long esize;
+  unsigned int i;
+
+  plugin = GNUNET_new (struct Plugin);
+  plugin->env = env;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (env->cfg,
+                                               "datastore-log",
+                                               "DIRECTORY",
+                                               &plugin->dir))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+			       "datastore-log",
+                               "DIRECTORY");
+    GNUNET_free (plugin);
+    return NULL;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (env->cfg,
+                                           "datastore-log",
+                                           "SEGMENT_SIZE",
+                                           &plugin->segment_size))
+    plugin->segment_size = DEFAULT_SEGMENT_SIZE;
+  if ( (plugin->segment_size < GNUNET_SERVER_MAX_MESSAGE_SIZE) ||
+       (plugin->segment_size > UINT32_MAX) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "datastore-log",
+                               "SEGMENT_SIZE",
+                               _("must be between 64 KiB and 4 GiB"));
+    GNUNET_free (plugin->dir);
+    GNUNET_free (plugin);
+    return NULL;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (env->cfg,
+					     "datastore-log",
+					     "HASHMAPSIZE",
+					     &esize))
+    esize = 128 * 1024;
+  if (GNUNET_YES != GNUNET_DISK_directory_test (plugin->dir,
+                                                GNUNET_NO))
+  {
+    if (GNUNET_OK != GNUNET_DISK_directory_create (plugin->dir))
+    {
+      GNUNET_free (plugin->dir);
+      GNUNET_free (plugin);
+      return NULL;
+    }
+    /* database is new or got deleted, reset payload to zero! */
+    env->duc (env->cls, 0);
+  }
+  plugin->keyvalue = GNUNET_CONTAINER_multihashmap_create (esize, GNUNET_YES);
+  plugin->by_uid = GNUNET_CONTAINER_multihashmap32_create (esize);
+  plugin->by_expiration = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  plugin->by_replication = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MAX);
+
+  /* rebuild the indices from the segments, oldest first */
+  memset (&sc, 0, sizeof (sc));
+  GNUNET_DISK_directory_scan (plugin->dir,
+                              &scan_segment,
+                              &sc);
+  if (sc.ids_len > 0)
+    qsort (sc.ids,
+           sc.ids_len,
+           sizeof (uint32_t),
+           &cmp_ids);
+  for (i = 0; i < sc.ids_len; i++)
+    if (NULL == segment_open (plugin, sc.ids[i]))
+      break;
+  GNUNET_array_grow (sc.ids,
+                     sc.ids_len,
+                     0);
+  for (seg = plugin->seg_head; NULL != seg; seg = seg->next)
+    replay_segment (plugin, seg);
+  LOG (GNUNET_ERROR_TYPE_INFO,
+       _("Log database running with %u blocks in %llu bytes\n"),
+       GNUNET_CONTAINER_multihashmap_size (plugin->keyvalue),
+       plugin->disk_size);
+
+  api = GNUNET_new (struct GNUNET_DATASTORE_PluginFunctions);
+  api->cls = plugin;
+  api->estimate_size = &log_plugin_estimate_size;
+  api->put = &log_plugin_put;
+  api->update = &log_plugin_update;
+  api->get_key = &log_plugin_get_key;
+  api->get_replication = &log_plugin_get_replication;
+  api->get_expiration = &log_plugin_get_expiration;
+  api->get_zero_anonymity = &log_plugin_get_zero_anonymity;
+  api->drop = &log_plugin_drop;
+  api->get_keys = &log_get_keys;
+  check_compaction (plugin);
+  return api;
+}
+
+
+/**
+ * Callback invoked to free all values.
+ *
+ * @param cls the plugin
+ * @param key unused
+ * @param val the value
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_value (void *cls,
+	    const struct GNUNET_HashCode *key,
+	    void *val)
+{
+  struct Plugin *plugin = cls;
+  struct Value *value = val;
+
+  forget_value (plugin, value);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Exit point from the plugin.
+ *
+ * @param cls our `struct GNUNET_DATASTORE_PluginFunctions *`
+ * @return always NULL
+ */
+void *
+libgnunet_plugin_datastore_log_done (void *cls)
+{
+  struct GNUNET_DATASTORE_PluginFunctions *api = cls;
+  struct Plugin *plugin = api->cls;
+
+  if (NULL != plugin->compact_task)
+  {
+    GNUNET_SCHEDULER_cancel (plugin->compact_task);
+    plugin->compact_task = NULL;
+  }
+  GNUNET_CONTAINER_multihashmap_iterate (plugin->keyvalue,
+					 &free_value,
+					 plugin);
+  while (NULL != plugin->seg_head)
+    segment_close (plugin,
+                   plugin->seg_head,
+                   plugin->drop_on_shutdown);
+  if ( (GNUNET_YES == plugin->drop_on_shutdown) &&
+       (0 != RMDIR (plugin->dir)) )
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "rmdir",
+                       plugin->dir);
+  GNUNET_CONTAINER_multihashmap_destroy (plugin->keyvalue);
+  GNUNET_CONTAINER_multihashmap32_destroy (plugin->by_uid);
+  GNUNET_CONTAINER_heap_destroy (plugin->by_expiration);
+  GNUNET_CONTAINER_heap_destroy (plugin->by_replication);
+  GNUNET_free (plugin->dir);
+  GNUNET_free (plugin);
+  GNUNET_free (api);
+  return NULL;
+}
+
+/* end of plugin_datastore_log.c */
@@ -48,6 +48,12 @@
  */
 #define BUSY_TIMEOUT_MS 250
 
+/**
+ * How many replication candidates do we select from the database
+ * at once?
+ */
+#define REPL_QUEUE_SIZE 32
+
 
 /**
  * Log an error message at log-level 'level' that indicates
@@ -107,9 +113,14 @@ struct Plugin
   sqlite3_stmt *updRepl;
 
   /**
-   * Precompiled SQL for replication selection.
+   * Precompiled SQL for selecting a batch of replication candidates.
+   */
+  sqlite3_stmt *selReplBatch;
+
+  /**
+   * Precompiled SQL for fetching an entry by row identifier.
    */
-  sqlite3_stmt *selRepl;
+  sqlite3_stmt *selRow;
 
   /**
    * Precompiled SQL for expiration selection.
@@ -126,6 +137,30 @@ struct Plugin
    */
   sqlite3_stmt *insertContent;
 
+  /**
+   * Exact number of bytes stored (payload plus per-entry overhead),
+   * computed once at startup and kept current on every insert and
+   * delete.
+   */
+  unsigned long long payload;
+
+  /**
+   * Row identifiers of the next entries to hand out for replication:
+   * a run of entries from the band with the highest replication
+   * counter, in 'rvalue' order starting at a random point.
+   */
+  unsigned long long repl_queue[REPL_QUEUE_SIZE];
+
+  /**
+   * Number of valid entries in @e repl_queue.
+   */
+  unsigned int repl_queue_len;
+
+  /**
+   * Offset of the next entry in @e repl_queue to hand out.
+   */
+  unsigned int repl_queue_off;
+
   /**
    * Should the database be dropped on shutdown?
    */
@@ -191,6 +226,10 @@ create_indices (sqlite3 * dbh)
        sqlite3_exec (dbh,
                      "CREATE INDEX IF NOT EXISTS idx_expire ON gn090 (expire ASC)",
                      NULL, NULL, NULL)) ||
+      (SQLITE_OK !=
+       sqlite3_exec (dbh,
+                     "CREATE INDEX IF NOT EXISTS idx_prio_expire ON gn090 (prio ASC,expire ASC)",
+                     NULL, NULL, NULL)) ||
       (SQLITE_OK !=
        sqlite3_exec (dbh,
                      "CREATE INDEX IF NOT EXISTS idx_repl_rvalue ON gn090 (repl,rvalue)",
@@ -319,17 +358,16 @@ database_setup (const struct GNUNET_CONFIGURATION_Handle *cfg,
         &plugin->updRepl) != SQLITE_OK) ||
       (sq_prepare
        (plugin->dbh,
-        "SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
+        "SELECT _ROWID_ FROM gn090 "
 #if SQLITE_VERSION_NUMBER >= 3007000
         "INDEXED BY idx_repl_rvalue "
 #endif
-        "WHERE repl=?2 AND " " (rvalue>=?1 OR "
-        "  NOT EXISTS (SELECT 1 FROM gn090 "
-#if SQLITE_VERSION_NUMBER >= 3007000
-        "INDEXED BY idx_repl_rvalue "
-#endif
-        "WHERE repl=?2 AND rvalue>=?1 LIMIT 1) ) "
-        "ORDER BY rvalue ASC LIMIT 1", &plugin->selRepl) != SQLITE_OK) ||
+        "WHERE repl=?2 AND rvalue>=?1 "
+        "ORDER BY rvalue ASC LIMIT ?3", &plugin->selReplBatch) != SQLITE_OK) ||
+      (sq_prepare
+       (plugin->dbh,
+        "SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
+        "WHERE _ROWID_=?1", &plugin->selRow) != SQLITE_OK) ||
       (sq_prepare (plugin->dbh, "SELECT MAX(repl) FROM gn090"
 #if SQLITE_VERSION_NUMBER >= 3007000
                    " INDEXED BY idx_repl_rvalue"
@@ -337,12 +375,20 @@ database_setup (const struct GNUNET_CONFIGURATION_Handle *cfg,
                    "", &plugin->maxRepl) != SQLITE_OK) ||
       (sq_prepare
        (plugin->dbh,
-        "SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
+        "SELECT * FROM "
+        "(SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
 #if SQLITE_VERSION_NUMBER >= 3007000
         "INDEXED BY idx_expire "
 #endif
-        "WHERE NOT EXISTS (SELECT 1 FROM gn090 WHERE expire < ?1 LIMIT 1) OR (expire < ?1) "
-        "ORDER BY expire ASC LIMIT 1", &plugin->selExpi) != SQLITE_OK) ||
+        "WHERE expire < ?1 ORDER BY expire ASC LIMIT 1) "
+        "UNION ALL "
+        "SELECT * FROM "
+        "(SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
+#if SQLITE_VERSION_NUMBER >= 3007000
+        "INDEXED BY idx_prio_expire "
+#endif
+        "ORDER BY prio ASC, expire ASC LIMIT 1) "
+        "LIMIT 1", &plugin->selExpi) != SQLITE_OK) ||
       (sq_prepare
        (plugin->dbh,
         "SELECT type,prio,anonLevel,expire,hash,value,_ROWID_ " "FROM gn090 "
@@ -364,11 +410,49 @@ database_setup (const struct GNUNET_CONFIGURATION_Handle *cfg,
     LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR, "precompiling");
     return GNUNET_SYSERR;
   }
-
+  /* count once at startup; afterwards the size is maintained
+     incrementally by #update_payload() */
+  plugin->payload = 0;
+  CHECK (SQLITE_OK ==
+         sq_prepare (plugin->dbh,
+                     "SELECT COUNT(*), IFNULL(SUM(LENGTH(value)),0) FROM gn090",
+                     &stmt));
+  if (SQLITE_ROW == sqlite3_step (stmt))
+    plugin->payload
+      = (unsigned long long) sqlite3_column_int64 (stmt, 0) * GNUNET_DATASTORE_ENTRY_OVERHEAD
+      + (unsigned long long) sqlite3_column_int64 (stmt, 1);
+  else
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_WARNING, "sqlite3_step");
+  sqlite3_finalize (stmt);
   return GNUNET_OK;
 }
 
 
+/**
+ * Account for a change in the amount of data stored and
+ * tell the service about it.
+ *
+ * @param plugin the plugin context (state for this module)
+ * @param delta change in bytes (including per-entry overhead)
+ */
+static void
+update_payload (struct Plugin *plugin,
+                int delta)
+{
+  if ( (delta < 0) &&
+       (plugin->payload < (unsigned long long) -delta) )
+  {
+    GNUNET_break (0);
+    plugin->payload = 0;
+  }
+  else
+  {
+    plugin->payload += delta;
+  }
+  plugin->env->duc (plugin->env->cls, delta);
+}
+
+
 /**
  * Shutdown database connection and associate data
  * structures.
@@ -390,10 +474,12 @@ database_shutdown (struct Plugin *plugin)
     sqlite3_finalize (plugin->updPrio);
   if (plugin->updRepl != NULL)
     sqlite3_finalize (plugin->updRepl);
-  if (plugin->selRepl != NULL)
-    sqlite3_finalize (plugin->selRepl);
   if (plugin->maxRepl != NULL)
     sqlite3_finalize (plugin->maxRepl);
+  if (plugin->selReplBatch != NULL)
+    sqlite3_finalize (plugin->selReplBatch);
+  if (plugin->selRow != NULL)
+    sqlite3_finalize (plugin->selRow);
   if (plugin->selExpi != NULL)
     sqlite3_finalize (plugin->selExpi);
   if (plugin->selZeroAnon != NULL)
@@ -439,6 +525,15 @@ static int
 delete_by_rowid (struct Plugin *plugin,
                  unsigned long long rid)
 {
+  unsigned int i;
+
+  for (i = plugin->repl_queue_off; i < plugin->repl_queue_len; i++)
+    if (plugin->repl_queue[i] == rid)
+    {
+      plugin->repl_queue[i] =
+          plugin->repl_queue[plugin->repl_queue_off++];
+      break;
+    }
   if (SQLITE_OK != sqlite3_bind_int64 (plugin->delRow, 1, rid))
   {
     LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
@@ -546,7 +641,7 @@ sqlite_plugin_put (void *cls,
   switch (n)
   {
   case SQLITE_DONE:
-    plugin->env->duc (plugin->env->cls, size + GNUNET_DATASTORE_ENTRY_OVERHEAD);
+    update_payload (plugin, size + GNUNET_DATASTORE_ENTRY_OVERHEAD);
     GNUNET_log_from (GNUNET_ERROR_TYPE_DEBUG, "sqlite",
                      "Stored new entry (%u bytes)\n",
                      size + GNUNET_DATASTORE_ENTRY_OVERHEAD);
@@ -691,8 +786,8 @@ execute_get (struct Plugin *plugin,
                     GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                     "sqlite3_reset");
       if (GNUNET_OK == delete_by_rowid (plugin, rowid))
-        plugin->env->duc (plugin->env->cls,
-                          -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
+        update_payload (plugin,
+                        -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
       break;
     }
     expiration.abs_value_us = sqlite3_column_int64 (stmt, 3);
@@ -710,8 +805,8 @@ execute_get (struct Plugin *plugin,
                   GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                   "sqlite3_reset");
     if ((GNUNET_NO == ret) && (GNUNET_OK == delete_by_rowid (plugin, rowid)))
-      plugin->env->duc (plugin->env->cls,
-                        -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
+      update_payload (plugin,
+                      -(size + GNUNET_DATASTORE_ENTRY_OVERHEAD));
     return;
   case SQLITE_DONE:
     /* database must be empty */
@@ -978,12 +1073,103 @@ repl_proc (void *cls,
 }
 
 
+/**
+ * Select up to #REPL_QUEUE_SIZE rows with the given replication
+ * value and an 'rvalue' of at least @a rvalue into the replication
+ * queue of @a plugin.
+ *
+ * @param plugin the plugin context
+ * @param repl replication value of the band to select from
+ * @param rvalue smallest 'rvalue' to select
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+fill_repl_queue (struct Plugin *plugin,
+                 uint32_t repl,
+                 uint64_t rvalue)
+{
+  sqlite3_stmt *stmt = plugin->selReplBatch;
+  int ret;
+
+  plugin->repl_queue_off = 0;
+  plugin->repl_queue_len = 0;
+  if ((SQLITE_OK != sqlite3_bind_int64 (stmt, 1, rvalue)) ||
+      (SQLITE_OK != sqlite3_bind_int (stmt, 2, repl)) ||
+      (SQLITE_OK != sqlite3_bind_int (stmt, 3, REPL_QUEUE_SIZE)))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_bind_XXXX");
+    if (SQLITE_OK != sqlite3_reset (stmt))
+      LOG_SQLITE (plugin,
+                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                  "sqlite3_reset");
+    return GNUNET_SYSERR;
+  }
+  while (SQLITE_ROW == (ret = sqlite3_step (stmt)))
+    plugin->repl_queue[plugin->repl_queue_len++] =
+        sqlite3_column_int64 (stmt, 0);
+  if (SQLITE_DONE != ret)
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_step");
+  if (SQLITE_OK != sqlite3_reset (stmt))
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_reset");
+  return (SQLITE_DONE == ret) ? GNUNET_OK : GNUNET_SYSERR;
+}
+
+
+/**
+ * Refill the replication queue with the next run of candidates
+ * from the band with the highest replication counter, starting at
+ * a random 'rvalue' (and wrapping around to the start of the band
+ * if nothing follows).  Both selections are range scans on
+ * 'idx_repl_rvalue'.
+ *
+ * @param plugin the plugin context
+ * @return #GNUNET_OK if the queue now has entries,
+ *         #GNUNET_NO if the database is empty,
+ *         #GNUNET_SYSERR on error
+ */
+static int
+refill_repl_queue (struct Plugin *plugin)
+{
+  sqlite3_stmt *stmt = plugin->maxRepl;
+  uint32_t repl;
+
+  if (SQLITE_ROW != sqlite3_step (stmt))
+  {
+    if (SQLITE_OK != sqlite3_reset (stmt))
+      LOG_SQLITE (plugin,
+                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                  "sqlite3_reset");
+    return GNUNET_NO;
+  }
+  repl = sqlite3_column_int (stmt, 0);
+  if (SQLITE_OK != sqlite3_reset (stmt))
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_reset");
+  if (GNUNET_OK !=
+      fill_repl_queue (plugin, repl,
+                       GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                                 UINT64_MAX)))
+    return GNUNET_SYSERR;
+  if ((0 == plugin->repl_queue_len) &&
+      (GNUNET_OK != fill_repl_queue (plugin, repl, 0)))
+    return GNUNET_SYSERR;
+  return (0 == plugin->repl_queue_len) ? GNUNET_NO : GNUNET_OK;
+}
+
+
 /**
  * Get a random item for replication.  Returns a single random item
  * from those with the highest replication counters.  The item's
  * replication counter is decremented by one IF it was positive before.
  * Call @a proc with all values ZERO or NULL if the datastore is empty.
  *
+ * Candidates are taken from a queue that is refilled with a run of
+ * #REPL_QUEUE_SIZE entries from the highest band whenever it is
+ * exhausted, so most calls only cost a lookup by row identifier.
+ *
  * @param cls closure
  * @param proc function to call the value (once only).
  * @param proc_cls closure for @a proc
@@ -994,8 +1180,6 @@ sqlite_plugin_get_replication (void *cls, PluginDatumProcessor proc,
 {
   struct Plugin *plugin = cls;
   struct ReplCtx rc;
-  uint64_t rvalue;
-  uint32_t repl;
   sqlite3_stmt *stmt;
 
   GNUNET_log_from (GNUNET_ERROR_TYPE_DEBUG, "sqlite",
@@ -1003,35 +1187,17 @@ sqlite_plugin_get_replication (void *cls, PluginDatumProcessor proc,
   rc.have_uid = GNUNET_NO;
   rc.proc = proc;
   rc.proc_cls = proc_cls;
-  stmt = plugin->maxRepl;
-  if (SQLITE_ROW != sqlite3_step (stmt))
+  if ((plugin->repl_queue_off == plugin->repl_queue_len) &&
+      (GNUNET_OK != refill_repl_queue (plugin)))
   {
-    if (SQLITE_OK != sqlite3_reset (stmt))
-      LOG_SQLITE (plugin,
-                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                  "sqlite3_reset");
-    /* DB empty */
+    /* DB empty (or error) */
     proc (proc_cls, NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
     return;
   }
-  repl = sqlite3_column_int (stmt, 0);
-  if (SQLITE_OK != sqlite3_reset (stmt))
-    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite3_reset");
-  stmt = plugin->selRepl;
-  rvalue = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK, UINT64_MAX);
-  if (SQLITE_OK != sqlite3_bind_int64 (stmt, 1, rvalue))
-  {
-    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                "sqlite3_bind_XXXX");
-    if (SQLITE_OK != sqlite3_reset (stmt))
-      LOG_SQLITE (plugin,
-                  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
-                  "sqlite3_reset");
-    proc (proc_cls, NULL, 0, NULL, 0, 0, 0, GNUNET_TIME_UNIT_ZERO_ABS, 0);
-    return;
-  }
-  if (SQLITE_OK != sqlite3_bind_int (stmt, 2, repl))
+  stmt = plugin->selRow;
+  if (SQLITE_OK !=
+      sqlite3_bind_int64 (stmt, 1,
+                          plugin->repl_queue[plugin->repl_queue_off++]))
   {
     LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
                 "sqlite3_bind_XXXX");
@@ -1158,53 +1324,60 @@ sqlite_plugin_drop (void *cls)
 
 
 /**
- * Get an estimate of how much space the database is
- * currently using.
+ * Start a batch of operations; everything up to the matching
+ * #sqlite_plugin_commit_batch() runs in one transaction, so that
+ * a batch of puts costs a single journal sync.
+ *
+ * @param cls our plugin context
+ */
+static void
+sqlite_plugin_begin_batch (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh, "BEGIN", NULL, NULL, NULL))
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+}
+
+
+/**
+ * Commit a batch of operations started with
+ * #sqlite_plugin_begin_batch().
+ *
+ * @param cls our plugin context
+ */
+static void
+sqlite_plugin_commit_batch (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  if (sqlite3_get_autocommit (plugin->dbh))
+    return; /* BEGIN failed, nothing to commit */
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh, "COMMIT", NULL, NULL, NULL))
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_exec");
+}
+
+
+/**
+ * Get the amount of data the database is currently storing.
+ * This is the exact running total (payload plus per-entry
+ * overhead); no pages need to be counted.
  *
  * @param cls the `struct Plugin`
- * @return the size of the database on disk (estimate)
+ * @param estimate set to the number of bytes stored
  */
 static void
 sqlite_plugin_estimate_size (void *cls, unsigned long long *estimate)
 {
   struct Plugin *plugin = cls;
-  sqlite3_stmt *stmt;
-  uint64_t pages;
-  uint64_t page_size;
-
-#if ENULL_DEFINED
-  char *e;
-#endif
 
   if (NULL == estimate)
     return;
-  if (SQLITE_VERSION_NUMBER < 3006000)
-  {
-    GNUNET_log_from (GNUNET_ERROR_TYPE_WARNING, "datastore-sqlite",
-                     _
-                     ("sqlite version to old to determine size, assuming zero\n"));
-    *estimate = 0;
-    return;
-  }
-  CHECK (SQLITE_OK == sqlite3_exec (plugin->dbh, "VACUUM", NULL, NULL, ENULL));
-  CHECK (SQLITE_OK ==
-         sqlite3_exec (plugin->dbh, "PRAGMA auto_vacuum=INCREMENTAL", NULL,
-                       NULL, ENULL));
-  CHECK (SQLITE_OK == sq_prepare (plugin->dbh, "PRAGMA page_count", &stmt));
-  if (SQLITE_ROW == sqlite3_step (stmt))
-    pages = sqlite3_column_int64 (stmt, 0);
-  else
-    pages = 0;
-  sqlite3_finalize (stmt);
-  CHECK (SQLITE_OK == sq_prepare (plugin->dbh, "PRAGMA page_size", &stmt));
-  CHECK (SQLITE_ROW == sqlite3_step (stmt));
-  page_size = sqlite3_column_int64 (stmt, 0);
-  sqlite3_finalize (stmt);
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-              _
-              ("Using sqlite page utilization to estimate payload (%llu pages of size %llu bytes)\n"),
-              (unsigned long long) pages, (unsigned long long) page_size);
-  *estimate = pages * page_size;
+  *estimate = plugin->payload;
 }
 
 
@@ -1241,6 +1414,8 @@ libgnunet_plugin_datastore_sqlite_init (void *cls)
   api->get_zero_anonymity = &sqlite_plugin_get_zero_anonymity;
   api->get_keys = &sqlite_plugin_get_keys;
   api->drop = &sqlite_plugin_drop;
+  api->begin_batch = &sqlite_plugin_begin_batch;
+  api->commit_batch = &sqlite_plugin_commit_batch;
   GNUNET_log_from (GNUNET_ERROR_TYPE_INFO, "sqlite",
                    _("Sqlite database running\n"));
   return api;
@@ -40,6 +40,11 @@
 
 #define ITERATIONS 256
 
+/**
+ * How many items do we store with a single batch PUT?
+ */
+#define BATCH_SIZE 16
+
 /**
  * Handle to the datastore.
  */
@@ -131,6 +136,10 @@ enum RunPhase
   RP_GET_MULTIPLE_NEXT = 10,
   RP_UPDATE = 11,
   RP_UPDATE_VALIDATE = 12,
+  RP_PUT_BATCH = 13,
+  RP_GET_MULTI = 14,
+  RP_GET_REPLICATION = 15,
+  RP_GET_ZERO_ANONYMITY = 16,
 
   /**
    * Execution failed with some kind of error.
@@ -160,6 +169,7 @@ struct CpsRunContext
   uint64_t uid;
   uint64_t offset;
   uint64_t first_uid;
+  unsigned int multi_results;
 };
 
 
@@ -379,7 +389,7 @@ check_update (void *cls,
   GNUNET_assert (key != NULL);
   if ((anonymity == get_anonymity (42)) && (size == get_size (42)) &&
       (priority == get_priority (42) + 100))
-    crc->phase = RP_DONE;
+    crc->phase = RP_PUT_BATCH;
   else
   {
     GNUNET_assert (size == get_size (43));
@@ -389,6 +399,195 @@ check_update (void *cls,
 }
 
 
+/**
+ * Compute the key of the @a i-th item of the batch PUT.
+ *
+ * @param i index of the item
+ * @param key set to the key of the item
+ */
+static void
+get_batch_key (int i,
+               struct GNUNET_HashCode *key)
+{
+  int j;
+
+  j = ITERATIONS + i;
+  GNUNET_CRYPTO_hash (&j, sizeof (int), key);
+}
+
+
+static void
+check_multi (void *cls,
+             const struct GNUNET_HashCode *key,
+             size_t size,
+             const void *data,
+             enum GNUNET_BLOCK_Type type,
+             uint32_t priority,
+             uint32_t anonymity,
+             struct GNUNET_TIME_Absolute expiration,
+             uint64_t uid)
+{
+  struct CpsRunContext *crc = cls;
+  struct GNUNET_HashCode bkey;
+  int i;
+
+  if (NULL != key)
+  {
+    GNUNET_assert (size == sizeof (int));
+    memcpy (&i, data, sizeof (int));
+    GNUNET_assert ( (i >= 0) && (i < BATCH_SIZE) );
+    get_batch_key (i, &bkey);
+    GNUNET_assert (0 == memcmp (&bkey, key, sizeof (struct GNUNET_HashCode)));
+    GNUNET_assert (type == get_type (i));
+    crc->multi_results++;
+    return;
+  }
+  if (BATCH_SIZE == crc->multi_results)
+  {
+    crc->phase = RP_GET_REPLICATION;
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Multi-key GET returned %u results, expected %u\n",
+                crc->multi_results,
+                BATCH_SIZE);
+    crc->phase = RP_ERROR;
+  }
+  GNUNET_SCHEDULER_add_now (&run_continuation, crc);
+}
+
+
+static void
+check_replication (void *cls,
+                   const struct GNUNET_HashCode *key,
+                   size_t size,
+                   const void *data,
+                   enum GNUNET_BLOCK_Type type,
+                   uint32_t priority,
+                   uint32_t anonymity,
+                   struct GNUNET_TIME_Absolute expiration,
+                   uint64_t uid)
+{
+  struct CpsRunContext *crc = cls;
+
+  if (NULL != key)
+  {
+    crc->multi_results++;
+    return;
+  }
+  if ( (crc->multi_results > 0) &&
+       (crc->multi_results <= BATCH_SIZE / 2) )
+  {
+    crc->phase = RP_GET_ZERO_ANONYMITY;
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Replication stream returned %u results, expected 1 to %u\n",
+                crc->multi_results,
+                BATCH_SIZE / 2);
+    crc->phase = RP_ERROR;
+  }
+  GNUNET_SCHEDULER_add_now (&run_continuation, crc);
+}
+
+
+static void
+check_zero_anonymity (void *cls,
+                      const struct GNUNET_HashCode *key,
+                      size_t size,
+                      const void *data,
+                      enum GNUNET_BLOCK_Type type,
+                      uint32_t priority,
+                      uint32_t anonymity,
+                      struct GNUNET_TIME_Absolute expiration,
+                      uint64_t uid)
+{
+  struct CpsRunContext *crc = cls;
+
+  if (NULL != key)
+  {
+    GNUNET_assert (0 == anonymity);
+    GNUNET_assert (type == get_type (0));
+    crc->multi_results++;
+    return;
+  }
+  if ( (crc->multi_results > 0) &&
+       (crc->multi_results <= BATCH_SIZE) )
+  {
+    crc->phase = RP_DONE;
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Zero-anonymity stream returned %u results, expected 1 to %u\n",
+                crc->multi_results,
+                BATCH_SIZE);
+    crc->phase = RP_ERROR;
+  }
+  GNUNET_SCHEDULER_add_now (&run_continuation, crc);
+}
+
+
+/**
+ * Store #BATCH_SIZE items with a single batch PUT.
+ *
+ * @param crc test context
+ */
+static void
+put_batch (struct CpsRunContext *crc)
+{
+  struct GNUNET_DATASTORE_PutItem items[BATCH_SIZE];
+  struct GNUNET_HashCode keys[BATCH_SIZE];
+  int values[BATCH_SIZE];
+  int i;
+
+  for (i = 0; i < BATCH_SIZE; i++)
+  {
+    get_batch_key (i, &keys[i]);
+    values[i] = i;
+    items[i].key = &keys[i];
+    items[i].size = sizeof (int);
+    items[i].data = &values[i];
+    items[i].type = get_type (i);
+    items[i].priority = get_priority (i);
+    items[i].anonymity = get_anonymity (i);
+    items[i].replication = 0;
+    items[i].expiration = get_expiration (i);
+  }
+  GNUNET_assert (NULL !=
+                 GNUNET_DATASTORE_put_batch (datastore, 0,
+                                             items, BATCH_SIZE,
+                                             1, 1, TIMEOUT,
+                                             &check_success, crc));
+}
+
+
+/**
+ * Look up all keys of the batch PUT (plus one that was never
+ * stored) with a single multi-key GET.
+ *
+ * @param crc test context
+ */
+static void
+get_multi (struct CpsRunContext *crc)
+{
+  struct GNUNET_HashCode keys[BATCH_SIZE + 1];
+  int i;
+
+  for (i = 0; i < BATCH_SIZE + 1; i++)
+    get_batch_key (i, &keys[i]);
+  crc->multi_results = 0;
+  GNUNET_assert (NULL !=
+                 GNUNET_DATASTORE_get_keys_multi (datastore,
+                                                  keys, BATCH_SIZE + 1,
+                                                  GNUNET_BLOCK_TYPE_ANY,
+                                                  1, 1, TIMEOUT,
+                                                  &check_multi, crc));
+}
+
+
 /**
  * Main state machine.  Executes the next step of the test
  * depending on the current state.
@@ -542,6 +741,35 @@ run_continuation (void *cls,
                                              TIMEOUT,
                                              &check_update, crc));
     break;
+  case RP_PUT_BATCH:
+    crc->phase = RP_GET_MULTI;
+    put_batch (crc);
+    break;
+  case RP_GET_MULTI:
+    get_multi (crc);
+    break;
+  case RP_GET_REPLICATION:
+    crc->multi_results = 0;
+    GNUNET_assert (NULL !=
+                   GNUNET_DATASTORE_get_for_replication_multi (datastore,
+                                                               BATCH_SIZE / 2,
+                                                               1, 1,
+                                                               TIMEOUT,
+                                                               &check_replication,
+                                                               crc));
+    break;
+  case RP_GET_ZERO_ANONYMITY:
+    crc->multi_results = 0;
+    GNUNET_assert (NULL !=
+                   GNUNET_DATASTORE_get_zero_anonymity_multi (datastore,
+                                                              0,
+                                                              BATCH_SIZE,
+                                                              1, 1,
+                                                              TIMEOUT,
+                                                              get_type (0),
+                                                              &check_zero_anonymity,
+                                                              crc));
+    break;
   case RP_DONE:
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Finished, disconnecting\n");
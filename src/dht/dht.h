@@ -233,6 +233,72 @@ struct GNUNET_DHT_ClientPutMessage
 };
 
 
+/**
+ * Message to insert several items into the DHT, sent from clients to DHT
+ * service.  Confirmed with a single #GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_OK.
+ */
+struct GNUNET_DHT_ClientPutBatchMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_BATCH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Message options, actually an 'enum GNUNET_DHT_RouteOption' value.
+   */
+  uint32_t options GNUNET_PACKED;
+
+  /**
+   * Replication level for all records.
+   */
+  uint32_t desired_replication_level GNUNET_PACKED;
+
+  /**
+   * Number of records that follow.
+   */
+  uint32_t record_count GNUNET_PACKED;
+
+  /**
+   * Unique ID for the PUT message.
+   */
+  uint64_t unique_id GNUNET_PACKED;
+
+  /* followed by record_count 'struct GNUNET_DHT_ClientPutBatchRecord' */
+
+};
+
+
+/**
+ * Record in a #GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_BATCH message.
+ */
+struct GNUNET_DHT_ClientPutBatchRecord
+{
+  /**
+   * The type of data to insert.
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Number of bytes of data following the record.
+   */
+  uint32_t data_size GNUNET_PACKED;
+
+  /**
+   * How long should this data persist?
+   */
+  struct GNUNET_TIME_AbsoluteNBO expiration;
+
+  /**
+   * The key to store the value under.
+   */
+  struct GNUNET_HashCode key GNUNET_PACKED;
+
+  /* DATA copied to end of this record */
+
+};
+
+
 /**
  * Message to confirming receipt of PUT, sent from DHT service to clients.
  */
@@ -350,6 +416,16 @@ struct GNUNET_DHT_MonitorStartStopMessage
    * The key to filter messages by.
    */
   struct GNUNET_HashCode key GNUNET_PACKED;
+
+  /**
+   * Report only one in this many matching messages (0 or 1 for all).
+   */
+  uint32_t sample_rate GNUNET_PACKED;
+
+  /**
+   * Monitor options (an `enum GNUNET_DHT_MonitorOption` value).
+   */
+  uint32_t options GNUNET_PACKED;
 };
 
 
@@ -282,6 +282,16 @@ struct GNUNET_DHT_MonitorHandle
    */
   void *cb_cls;
 
+  /**
+   * Sample rate requested from the service.
+   */
+  uint32_t sample_rate;
+
+  /**
+   * Options requested from the service.
+   */
+  enum GNUNET_DHT_MonitorOption options;
+
 };
 
 
@@ -1259,6 +1269,98 @@ GNUNET_DHT_put (struct GNUNET_DHT_Handle *handle,
 }
 
 
+/**
+ * Perform a PUT operation storing several records in the DHT with a
+ * single request.
+ *
+ * @param handle handle to DHT service
+ * @param num_records number of entries in @a records
+ * @param records the records to store
+ * @param desired_replication_level estimate of how many
+ *                nearest peers each record should reach
+ * @param options routing options for this message
+ * @param timeout how long to wait for transmission of this request
+ * @param cont continuation to call when done (transmitting request to service)
+ *        You must not call #GNUNET_DHT_disconnect in this continuation
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the "PUT" operation, NULL on error
+ *        (batch too big)
+ */
+struct GNUNET_DHT_PutHandle *
+GNUNET_DHT_put_batch (struct GNUNET_DHT_Handle *handle,
+                      unsigned int num_records,
+                      const struct GNUNET_DHT_PutRecord *records,
+                      uint32_t desired_replication_level,
+                      enum GNUNET_DHT_RouteOption options,
+                      struct GNUNET_TIME_Relative timeout,
+                      GNUNET_DHT_PutContinuation cont,
+                      void *cont_cls)
+{
+  struct GNUNET_DHT_ClientPutBatchMessage *put_msg;
+  struct GNUNET_DHT_ClientPutBatchRecord *rec;
+  struct PendingMessage *pending;
+  struct GNUNET_DHT_PutHandle *ph;
+  size_t msize;
+  unsigned int i;
+  char *off;
+
+  msize = sizeof (struct GNUNET_DHT_ClientPutBatchMessage);
+  for (i = 0; i < num_records; i++)
+  {
+    if (records[i].size >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
+    {
+      GNUNET_break (0);
+      return NULL;
+    }
+    msize += sizeof (struct GNUNET_DHT_ClientPutBatchRecord) + records[i].size;
+    if (msize >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
+    {
+      GNUNET_break (0);
+      return NULL;
+    }
+  }
+  ph = GNUNET_new (struct GNUNET_DHT_PutHandle);
+  ph->dht_handle = handle;
+  ph->timeout_task = GNUNET_SCHEDULER_add_delayed (timeout, &timeout_put_request, ph);
+  ph->cont = cont;
+  ph->cont_cls = cont_cls;
+  ph->unique_id = ++handle->uid_gen;
+  pending = GNUNET_malloc (sizeof (struct PendingMessage) + msize);
+  ph->pending = pending;
+  put_msg = (struct GNUNET_DHT_ClientPutBatchMessage *) &pending[1];
+  pending->msg = &put_msg->header;
+  pending->handle = handle;
+  pending->cont = &mark_put_message_gone;
+  pending->cont_cls = ph;
+  pending->free_on_send = GNUNET_YES;
+  put_msg->header.size = htons (msize);
+  put_msg->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_BATCH);
+  put_msg->options = htonl ((uint32_t) options);
+  put_msg->desired_replication_level = htonl (desired_replication_level);
+  put_msg->record_count = htonl (num_records);
+  put_msg->unique_id = ph->unique_id;
+  off = (char *) &put_msg[1];
+  for (i = 0; i < num_records; i++)
+  {
+    rec = (struct GNUNET_DHT_ClientPutBatchRecord *) off;
+    rec->type = htonl (records[i].type);
+    rec->data_size = htonl ((uint32_t) records[i].size);
+    rec->expiration = GNUNET_TIME_absolute_hton (records[i].expiration);
+    rec->key = records[i].key;
+    memcpy (&rec[1], records[i].data, records[i].size);
+    off += sizeof (struct GNUNET_DHT_ClientPutBatchRecord) + records[i].size;
+  }
+  GNUNET_CONTAINER_DLL_insert (handle->pending_head, handle->pending_tail,
+                               pending);
+  pending->in_pending_queue = GNUNET_YES;
+  GNUNET_CONTAINER_DLL_insert_tail (handle->put_head,
+				    handle->put_tail,
+				    ph);
+  process_pending_messages (handle);
+  return ph;
+}
+
+
 /**
  * Cancels a DHT PUT operation.  Note that the PUT request may still
  * go out over the network (we can't stop that); However, if the PUT
@@ -1473,6 +1575,40 @@ GNUNET_DHT_monitor_start (struct GNUNET_DHT_Handle *handle,
                           GNUNET_DHT_MonitorGetRespCB get_resp_cb,
                           GNUNET_DHT_MonitorPutCB put_cb,
                           void *cb_cls)
+{
+  return GNUNET_DHT_monitor_start_sampled (handle, type, key,
+                                           1, GNUNET_DHT_MO_NONE,
+                                           get_cb, get_resp_cb, put_cb,
+                                           cb_cls);
+}
+
+
+/**
+ * Start monitoring the local DHT service, only being told about a
+ * sample of the messages.
+ *
+ * @param handle Handle to the DHT service.
+ * @param type Type of blocks that are of interest.
+ * @param key Key of data of interest, NULL for all.
+ * @param sample_rate report only one in @a sample_rate matching
+ *        messages of each kind, 0 or 1 for all
+ * @param options what to report
+ * @param get_cb Callback to process monitored get messages.
+ * @param get_resp_cb Callback to process monitored get response messages.
+ * @param put_cb Callback to process monitored put messages.
+ * @param cb_cls Closure for callbacks
+ * @return Handle to stop monitoring.
+ */
+struct GNUNET_DHT_MonitorHandle *
+GNUNET_DHT_monitor_start_sampled (struct GNUNET_DHT_Handle *handle,
+                                  enum GNUNET_BLOCK_Type type,
+                                  const struct GNUNET_HashCode *key,
+                                  uint32_t sample_rate,
+                                  enum GNUNET_DHT_MonitorOption options,
+                                  GNUNET_DHT_MonitorGetCB get_cb,
+                                  GNUNET_DHT_MonitorGetRespCB get_resp_cb,
+                                  GNUNET_DHT_MonitorPutCB put_cb,
+                                  void *cb_cls)
 {
   struct GNUNET_DHT_MonitorHandle *h;
   struct GNUNET_DHT_MonitorStartStopMessage *m;
@@ -1486,6 +1622,8 @@ GNUNET_DHT_monitor_start (struct GNUNET_DHT_Handle *handle,
   h->put_cb = put_cb;
   h->cb_cls = cb_cls;
   h->type = type;
+  h->sample_rate = sample_rate;
+  h->options = options;
   h->dht_handle = handle;
   if (NULL != key)
   {
@@ -1505,6 +1643,8 @@ GNUNET_DHT_monitor_start (struct GNUNET_DHT_Handle *handle,
   m->get = htons(NULL != get_cb);
   m->get_resp = htons(NULL != get_resp_cb);
   m->put = htons(NULL != put_cb);
+  m->sample_rate = htonl (sample_rate);
+  m->options = htonl ((uint32_t) options);
   if (NULL != key) {
     m->filter_key = htons(1);
     memcpy (&m->key, key, sizeof(struct GNUNET_HashCode));
@@ -1547,6 +1687,8 @@ GNUNET_DHT_monitor_stop (struct GNUNET_DHT_MonitorHandle *handle)
   m->get = htons (NULL != handle->get_cb);
   m->get_resp = htons(NULL != handle->get_resp_cb);
   m->put = htons (NULL != handle->put_cb);
+  m->sample_rate = htonl (handle->sample_rate);
+  m->options = htonl ((uint32_t) handle->options);
   if (NULL != handle->key)
   {
     m->filter_key = htons (1);
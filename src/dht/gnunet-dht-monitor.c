@@ -41,6 +41,16 @@ static char *query_key;
  */
 static struct GNUNET_TIME_Relative timeout_request = { 60000 };
 
+/**
+ * Report only one in this many messages
+ */
+static unsigned int sample_rate;
+
+/**
+ * Only report message headers
+ */
+static int header_only;
+
 /**
  * Be verbose
  */
@@ -244,13 +254,17 @@ run (void *cls, char *const *args, const char *cfgfile,
 	     "Monitoring for %s\n",
 	     GNUNET_STRINGS_relative_time_to_string (timeout_request, GNUNET_NO));
   GNUNET_SCHEDULER_add_delayed (timeout_request, &cleanup_task, NULL);
-  monitor_handle = GNUNET_DHT_monitor_start (dht_handle,
-                                             block_type,
-                                             key,
-                                             &get_callback,
-                                             &get_resp_callback,
-                                             &put_callback,
-                                             NULL);
+  monitor_handle = GNUNET_DHT_monitor_start_sampled (dht_handle,
+                                                     block_type,
+                                                     key,
+                                                     sample_rate,
+                                                     header_only
+                                                     ? GNUNET_DHT_MO_HEADER_ONLY
+                                                     : GNUNET_DHT_MO_NONE,
+                                                     &get_callback,
+                                                     &get_resp_callback,
+                                                     &put_callback,
+                                                     NULL);
 }
 
 
@@ -258,9 +272,15 @@ run (void *cls, char *const *args, const char *cfgfile,
  * gnunet-dht-monitor command line options
  */
 static struct GNUNET_GETOPT_CommandLineOption options[] = {
+  {'H', "headers-only", NULL,
+   gettext_noop ("do not transmit paths and payloads"),
+   0, &GNUNET_GETOPT_set_one, &header_only},
   {'k', "key", "KEY",
    gettext_noop ("the query key"),
    1, &GNUNET_GETOPT_set_string, &query_key},
+  {'s', "sample-rate", "RATE",
+   gettext_noop ("only print one in RATE messages"),
+   1, &GNUNET_GETOPT_set_uint, &sample_rate},
   {'t', "type", "TYPE",
    gettext_noop ("the type of data to look for"),
    1, &GNUNET_GETOPT_set_uint, &block_type},
@@ -43,6 +43,17 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "dht-clients",__VA_ARGS__)
 
+/**
+ * How many neighbours do we ask in each round of a parallel lookup?
+ */
+#define PARALLEL_LOOKUP_ALPHA 3
+
+/**
+ * How long do we wait for a reply before starting the next round of a
+ * parallel lookup?
+ */
+#define PARALLEL_LOOKUP_ROUND_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
 /**
  * Linked list of messages to send to clients.
  */
@@ -106,6 +117,13 @@ struct ClientList
    */
   struct PendingMessage *pending_tail;
 
+  /**
+   * Number of the last monitoring event this client was notified
+   * about; used to avoid sending duplicates if several of its
+   * monitoring requests match the same event.
+   */
+  uint64_t monitor_event;
+
 };
 
 
@@ -140,6 +158,13 @@ struct ClientQueryRecord
    */
   struct GNUNET_CONTAINER_HeapNode *hnode;
 
+  /**
+   * Neighbours already asked by a parallel lookup, NULL if the
+   * request does not use #GNUNET_DHT_RO_PARALLEL_LOOKUP or no round
+   * was started yet.
+   */
+  struct GNUNET_CONTAINER_BloomFilter *queried_bf;
+
   /**
    * What's the delay between re-try operations that we currently use for this
    * request?
@@ -151,6 +176,12 @@ struct ClientQueryRecord
    */
   struct GNUNET_TIME_Absolute retry_time;
 
+  /**
+   * When did the client start the request?  Zero once the first
+   * result was delivered.
+   */
+  struct GNUNET_TIME_Absolute start_time;
+
   /**
    * The unique identifier of this request
    */
@@ -176,6 +207,12 @@ struct ClientQueryRecord
    */
   uint32_t msg_options;
 
+  /**
+   * Are we done with the parallel rounds of the lookup (a reply
+   * arrived or all neighbours were asked)?
+   */
+  int lookup_done;
+
   /**
    * The type for the data for the GET request.
    */
@@ -225,6 +262,21 @@ struct ClientMonitorRecord
    */
   uint16_t put;
 
+  /**
+   * Only one in this many matching events is reported (at least 1).
+   */
+  uint32_t sample_rate;
+
+  /**
+   * Number of matching events seen so far, used for sampling.
+   */
+  uint32_t sample_counter;
+
+  /**
+   * #GNUNET_YES if paths and payloads should not be transmitted.
+   */
+  int header_only;
+
   /**
    * Client to notify of these requests.
    */
@@ -267,6 +319,12 @@ static struct GNUNET_CONTAINER_Heap *retry_heap;
  */
 static struct GNUNET_SCHEDULER_Task * retry_task;
 
+/**
+ * Counter of monitoring events, used to avoid notifying a client
+ * twice about the same event.
+ */
+static uint64_t monitor_event_id;
+
 
 /**
  * Task run to check for messages that need to be sent to a client.
@@ -344,6 +402,8 @@ remove_client_records (void *cls, const struct GNUNET_HashCode * key, void *valu
                                                        record));
   if (NULL != record->hnode)
     GNUNET_CONTAINER_heap_remove_node (record->hnode);
+  if (NULL != record->queried_bf)
+    GNUNET_CONTAINER_bloomfilter_free (record->queried_bf);
   GNUNET_array_grow (record->seen_replies, record->seen_replies_count, 0);
   GNUNET_free (record);
   return GNUNET_YES;
@@ -422,6 +482,34 @@ transmit_request (struct ClientQueryRecord *cqr)
   reply_bf =
       GNUNET_BLOCK_construct_bloomfilter (reply_bf_mutator, cqr->seen_replies,
                                           cqr->seen_replies_count);
+  if ( (0 != (cqr->msg_options & GNUNET_DHT_RO_PARALLEL_LOOKUP)) &&
+       (GNUNET_NO == cqr->lookup_done) )
+  {
+    /* ask the next closest neighbours, the earlier rounds are still
+       being answered */
+    if (NULL == cqr->queried_bf)
+      cqr->queried_bf =
+          GNUNET_CONTAINER_bloomfilter_init (NULL, DHT_BLOOM_SIZE,
+                                             GNUNET_CONSTANTS_BLOOMFILTER_K);
+    if (GNUNET_OK ==
+        GDS_NEIGHBOURS_handle_get_parallel (cqr->type, cqr->msg_options,
+                                            cqr->replication,
+                                            PARALLEL_LOOKUP_ALPHA,
+                                            &cqr->key, cqr->xquery,
+                                            cqr->xquery_size, reply_bf,
+                                            reply_bf_mutator,
+                                            cqr->queried_bf))
+    {
+      GNUNET_CONTAINER_bloomfilter_free (reply_bf);
+      cqr->retry_frequency = PARALLEL_LOOKUP_ROUND_DELAY;
+      cqr->retry_time = GNUNET_TIME_relative_to_absolute (cqr->retry_frequency);
+      return;
+    }
+    /* all neighbours asked, continue with normal retries */
+    cqr->lookup_done = GNUNET_YES;
+    GNUNET_CONTAINER_bloomfilter_free (cqr->queried_bf);
+    cqr->queried_bf = NULL;
+  }
   peer_bf =
       GNUNET_CONTAINER_bloomfilter_init (NULL, DHT_BLOOM_SIZE,
                                          GNUNET_CONSTANTS_BLOOMFILTER_K);
@@ -484,6 +572,31 @@ transmit_next_request_task (void *cls,
 }
 
 
+/**
+ * Confirm to a client that its PUT was processed.
+ *
+ * @param client the client that issued the PUT
+ * @param unique_id unique ID of the PUT (in NBO)
+ */
+static void
+send_put_confirmation (struct GNUNET_SERVER_Client *client,
+                       uint64_t unique_id)
+{
+  struct PendingMessage *pm;
+  struct GNUNET_DHT_ClientPutConfirmationMessage *conf;
+
+  pm = GNUNET_malloc (sizeof (struct PendingMessage) +
+		      sizeof (struct GNUNET_DHT_ClientPutConfirmationMessage));
+  conf = (struct GNUNET_DHT_ClientPutConfirmationMessage *) &pm[1];
+  conf->header.size = htons (sizeof (struct GNUNET_DHT_ClientPutConfirmationMessage));
+  conf->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_OK);
+  conf->reserved = htonl (0);
+  conf->unique_id = unique_id;
+  pm->msg = &conf->header;
+  add_pending_message (find_active_client (client), pm);
+}
+
+
 /**
  * Handler for PUT messages.
  *
@@ -498,8 +611,6 @@ handle_dht_local_put (void *cls, struct GNUNET_SERVER_Client *client,
   const struct GNUNET_DHT_ClientPutMessage *dht_msg;
   struct GNUNET_CONTAINER_BloomFilter *peer_bf;
   uint16_t size;
-  struct PendingMessage *pm;
-  struct GNUNET_DHT_ClientPutConfirmationMessage *conf;
 
   size = ntohs (message->size);
   if (size < sizeof (struct GNUNET_DHT_ClientPutMessage))
@@ -552,15 +663,133 @@ handle_dht_local_put (void *cls, struct GNUNET_SERVER_Client *client,
                            &dht_msg[1],
                            size - sizeof (struct GNUNET_DHT_ClientPutMessage));
   GNUNET_CONTAINER_bloomfilter_free (peer_bf);
-  pm = GNUNET_malloc (sizeof (struct PendingMessage) +
-		      sizeof (struct GNUNET_DHT_ClientPutConfirmationMessage));
-  conf = (struct GNUNET_DHT_ClientPutConfirmationMessage *) &pm[1];
-  conf->header.size = htons (sizeof (struct GNUNET_DHT_ClientPutConfirmationMessage));
-  conf->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_OK);
-  conf->reserved = htonl (0);
-  conf->unique_id = dht_msg->unique_id;
-  pm->msg = &conf->header;
-  add_pending_message (find_active_client (client), pm);
+  send_put_confirmation (client, dht_msg->unique_id);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
+/**
+ * Handler for PUT batch messages.
+ *
+ * @param cls closure for the service
+ * @param client the client we received this message from
+ * @param message the actual message received
+ */
+static void
+handle_dht_local_put_batch (void *cls, struct GNUNET_SERVER_Client *client,
+                            const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_DHT_ClientPutBatchMessage *dht_msg;
+  const struct GNUNET_DHT_ClientPutBatchRecord *rec;
+  struct GNUNET_CONTAINER_BloomFilter *peer_bf;
+  struct GDS_PutRecord *records;
+  struct GNUNET_HashCode *keys;
+  enum GNUNET_DHT_RouteOption options;
+  uint32_t desired_replication_level;
+  uint32_t record_count;
+  uint32_t data_size;
+  const char *off;
+  const char *end;
+  unsigned int i;
+  uint16_t size;
+
+  size = ntohs (message->size);
+  if (size < sizeof (struct GNUNET_DHT_ClientPutBatchMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  dht_msg = (const struct GNUNET_DHT_ClientPutBatchMessage *) message;
+  record_count = ntohl (dht_msg->record_count);
+  if ((0 == record_count) ||
+      (record_count > size / sizeof (struct GNUNET_DHT_ClientPutBatchRecord)))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  records = GNUNET_new_array (record_count, struct GDS_PutRecord);
+  /* records are packed at arbitrary offsets, copy the keys out so
+     that we can pass aligned pointers to them */
+  keys = GNUNET_new_array (record_count, struct GNUNET_HashCode);
+  off = (const char *) &dht_msg[1];
+  end = ((const char *) message) + size;
+  for (i = 0; i < record_count; i++)
+  {
+    if ((size_t) (end - off) < sizeof (struct GNUNET_DHT_ClientPutBatchRecord))
+      break;
+    rec = (const struct GNUNET_DHT_ClientPutBatchRecord *) off;
+    data_size = ntohl (rec->data_size);
+    if ((size_t) (end - off) - sizeof (struct GNUNET_DHT_ClientPutBatchRecord)
+        < data_size)
+      break;
+    records[i].type = ntohl (rec->type);
+    records[i].expiration_time = GNUNET_TIME_absolute_ntoh (rec->expiration);
+    memcpy (&keys[i], &rec->key, sizeof (struct GNUNET_HashCode));
+    records[i].key = &keys[i];
+    records[i].data = &rec[1];
+    records[i].data_size = data_size;
+    off += sizeof (struct GNUNET_DHT_ClientPutBatchRecord) + data_size;
+  }
+  if ((i != record_count) || (off != end))
+  {
+    GNUNET_break (0);
+    GNUNET_free (records);
+    GNUNET_free (keys);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop
+                            ("# PUT requests received from clients"),
+                            record_count, GNUNET_NO);
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop
+                            ("# PUT batches received from clients"), 1,
+                            GNUNET_NO);
+  options = ntohl (dht_msg->options);
+  desired_replication_level = ntohl (dht_msg->desired_replication_level);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Handling local PUT batch of %u records\n",
+       (unsigned int) record_count);
+  for (i = 0; i < record_count; i++)
+  {
+    LOG_TRAFFIC (GNUNET_ERROR_TYPE_DEBUG, "R5N CLIENT-PUT %s\n",
+                 GNUNET_h2s_full (records[i].key));
+    /* give to local clients */
+    GDS_CLIENTS_handle_reply (records[i].expiration_time,
+                              records[i].key, 0, NULL, 0, NULL,
+                              records[i].type,
+                              records[i].data_size, records[i].data);
+    /* store locally */
+    GDS_DATACACHE_handle_put (records[i].expiration_time,
+                              records[i].key, 0, NULL, records[i].type,
+                              records[i].data_size, records[i].data);
+  }
+  /* route to other peers, one bloomfilter for the whole batch */
+  peer_bf =
+      GNUNET_CONTAINER_bloomfilter_init (NULL, DHT_BLOOM_SIZE,
+                                         GNUNET_CONSTANTS_BLOOMFILTER_K);
+  GDS_NEIGHBOURS_handle_put_batch (options, desired_replication_level,
+                                   0 /* hop count */ ,
+                                   peer_bf, 0, NULL,
+                                   record_count, records);
+  for (i = 0; i < record_count; i++)
+    GDS_CLIENTS_process_put (options,
+                             records[i].type,
+                             0,
+                             desired_replication_level,
+                             1,
+                             GDS_NEIGHBOURS_get_id(),
+                             records[i].expiration_time,
+                             records[i].key,
+                             records[i].data,
+                             records[i].data_size);
+  GNUNET_CONTAINER_bloomfilter_free (peer_bf);
+  GNUNET_free (records);
+  GNUNET_free (keys);
+  send_put_confirmation (client, dht_msg->unique_id);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -612,6 +841,7 @@ handle_dht_local_get (void *cls, struct GNUNET_SERVER_Client *client,
   cqr->hnode = GNUNET_CONTAINER_heap_insert (retry_heap, cqr, 0);
   cqr->retry_frequency = GNUNET_TIME_UNIT_SECONDS;
   cqr->retry_time = GNUNET_TIME_absolute_get ();
+  cqr->start_time = cqr->retry_time;
   cqr->unique_id = get->unique_id;
   cqr->xquery_size = xquery_size;
   cqr->replication = ntohl (get->desired_replication_level);
@@ -831,6 +1061,9 @@ handle_dht_local_monitor (void *cls, struct GNUNET_SERVER_Client *client,
   r->get = ntohs(msg->get);
   r->get_resp = ntohs(msg->get_resp);
   r->put = ntohs(msg->put);
+  r->sample_rate = GNUNET_MAX (1, ntohl (msg->sample_rate));
+  r->header_only = (0 != (ntohl (msg->options) & GNUNET_DHT_MO_HEADER_ONLY))
+    ? GNUNET_YES : GNUNET_NO;
   if (0 == ntohs(msg->filter_key))
       r->key = NULL;
   else
@@ -873,9 +1106,13 @@ handle_dht_local_monitor_stop (void *cls, struct GNUNET_SERVER_Client *client,
     }
     if (find_active_client(client) == r->client
         && ntohl(msg->type) == r->type
-        && r->get == msg->get
-        && r->get_resp == msg->get_resp
-        && r->put == msg->put
+        && r->get == ntohs (msg->get)
+        && r->get_resp == ntohs (msg->get_resp)
+        && r->put == ntohs (msg->put)
+        && r->sample_rate == GNUNET_MAX (1, ntohl (msg->sample_rate))
+        && r->header_only ==
+           ((0 != (ntohl (msg->options) & GNUNET_DHT_MO_HEADER_ONLY))
+            ? GNUNET_YES : GNUNET_NO)
         && keys_match
         )
     {
@@ -1126,9 +1363,36 @@ forward_reply (void *cls, const struct GNUNET_HashCode * key, void *value)
        "Queueing reply to query %s for client %p\n",
        GNUNET_h2s (key),
        record->client->client_handle);
+  if (0 != record->start_time.abs_value_us)
+  {
+    GNUNET_STATISTICS_observe (GDS_stats,
+                               gettext_noop ("# lookup time to first result (us)"),
+                               GNUNET_TIME_absolute_get_duration (record->start_time).rel_value_us,
+                               GNUNET_NO);
+    record->start_time = GNUNET_TIME_UNIT_ZERO_ABS;
+  }
   add_pending_message (record->client, pm);
   if (GNUNET_YES == do_free)
+  {
     remove_client_records (record->client, key, record);
+    return GNUNET_YES;
+  }
+  if ( (0 != (record->msg_options & GNUNET_DHT_RO_PARALLEL_LOOKUP)) &&
+       (GNUNET_NO == record->lookup_done) )
+  {
+    /* found the region holding the data, no further parallel rounds */
+    record->lookup_done = GNUNET_YES;
+    if (NULL != record->queried_bf)
+    {
+      GNUNET_CONTAINER_bloomfilter_free (record->queried_bf);
+      record->queried_bf = NULL;
+    }
+    record->retry_frequency = GNUNET_TIME_UNIT_SECONDS;
+    record->retry_time = GNUNET_TIME_relative_to_absolute (record->retry_frequency);
+    if (NULL != record->hnode)
+      GNUNET_CONTAINER_heap_update_cost (retry_heap, record->hnode,
+                                         record->retry_time.abs_value_us);
+  }
   return GNUNET_YES;
 }
 
@@ -1222,6 +1486,41 @@ GDS_CLIENTS_handle_reply (struct GNUNET_TIME_Absolute expiration,
 }
 
 
+/**
+ * Check if a monitoring request should be notified about the
+ * current monitoring event (#monitor_event_id).  Takes care of
+ * filtering, sampling and of not notifying the same client twice.
+ *
+ * @param m monitoring request to check
+ * @param interested flag of @a m for the kind of event
+ * @param type type of the block concerned by the event
+ * @param key key concerned by the event
+ * @return #GNUNET_YES if @a m's client should be notified
+ */
+static int
+monitor_match (struct ClientMonitorRecord *m,
+               int interested,
+               enum GNUNET_BLOCK_Type type,
+               const struct GNUNET_HashCode *key)
+{
+  if (0 == interested)
+    return GNUNET_NO;
+  if ( (GNUNET_BLOCK_TYPE_ANY != m->type) &&
+       (m->type != type) )
+    return GNUNET_NO;
+  if ( (NULL != m->key) &&
+       (0 != memcmp (key, m->key, sizeof (struct GNUNET_HashCode))) )
+    return GNUNET_NO;
+  /* Don't send duplicates */
+  if (m->client->monitor_event == monitor_event_id)
+    return GNUNET_NO;
+  if (0 != (m->sample_counter++ % m->sample_rate))
+    return GNUNET_NO;
+  m->client->monitor_event = monitor_event_id;
+  return GNUNET_YES;
+}
+
+
 /**
  * Check if some client is monitoring GET messages and notify
  * them in that case.
@@ -1244,32 +1543,22 @@ GDS_CLIENTS_process_get (uint32_t options,
                          const struct GNUNET_HashCode * key)
 {
   struct ClientMonitorRecord *m;
-  struct ClientList **cl;
-  unsigned int cl_size;
 
-  cl = NULL;
-  cl_size = 0;
+  if (NULL == monitor_head)
+    return;
+  monitor_event_id++;
   for (m = monitor_head; NULL != m; m = m->next)
   {
-    if ((GNUNET_BLOCK_TYPE_ANY == m->type || m->type == type) &&
-        (NULL == m->key ||
-         memcmp (key, m->key, sizeof(struct GNUNET_HashCode)) == 0))
+    if (GNUNET_YES == monitor_match (m, m->get, type, key))
     {
       struct PendingMessage *pm;
       struct GNUNET_DHT_MonitorGetMessage *mmsg;
       struct GNUNET_PeerIdentity *msg_path;
       size_t msize;
-      unsigned int i;
+      unsigned int plen;
 
-      /* Don't send duplicates */
-      for (i = 0; i < cl_size; i++)
-        if (cl[i] == m->client)
-          break;
-      if (i < cl_size)
-        continue;
-      GNUNET_array_append (cl, cl_size, m->client);
-
-      msize = path_length * sizeof (struct GNUNET_PeerIdentity);
+      plen = (GNUNET_YES == m->header_only) ? 0 : path_length;
+      msize = plen * sizeof (struct GNUNET_PeerIdentity);
       msize += sizeof (struct GNUNET_DHT_MonitorGetMessage);
       msize += sizeof (struct PendingMessage);
       pm = GNUNET_malloc (msize);
@@ -1281,16 +1570,15 @@ GDS_CLIENTS_process_get (uint32_t options,
       mmsg->type = htonl(type);
       mmsg->hop_count = htonl(hop_count);
       mmsg->desired_replication_level = htonl(desired_replication_level);
-      mmsg->get_path_length = htonl(path_length);
+      mmsg->get_path_length = htonl(plen);
       memcpy (&mmsg->key, key, sizeof (struct GNUNET_HashCode));
       msg_path = (struct GNUNET_PeerIdentity *) &mmsg[1];
-      if (path_length > 0)
+      if (plen > 0)
         memcpy (msg_path, path,
-                path_length * sizeof (struct GNUNET_PeerIdentity));
+                plen * sizeof (struct GNUNET_PeerIdentity));
       add_pending_message (m->client, pm);
     }
   }
-  GNUNET_free_non_null (cl);
 }
 
 
@@ -1320,33 +1608,36 @@ GDS_CLIENTS_process_get_resp (enum GNUNET_BLOCK_Type type,
                               size_t size)
 {
   struct ClientMonitorRecord *m;
-  struct ClientList **cl;
-  unsigned int cl_size;
 
-  cl = NULL;
-  cl_size = 0;
+  if (NULL == monitor_head)
+    return;
+  monitor_event_id++;
   for (m = monitor_head; NULL != m; m = m->next)
   {
-    if ((GNUNET_BLOCK_TYPE_ANY == m->type || m->type == type) &&
-        (NULL == m->key ||
-         memcmp (key, m->key, sizeof(struct GNUNET_HashCode)) == 0))
+    if (GNUNET_YES == monitor_match (m, m->get_resp, type, key))
     {
       struct PendingMessage *pm;
       struct GNUNET_DHT_MonitorGetRespMessage *mmsg;
       struct GNUNET_PeerIdentity *path;
       size_t msize;
-      unsigned int i;
-
-      /* Don't send duplicates */
-      for (i = 0; i < cl_size; i++)
-        if (cl[i] == m->client)
-          break;
-      if (i < cl_size)
-        continue;
-      GNUNET_array_append (cl, cl_size, m->client);
-
-      msize = size;
-      msize += (get_path_length + put_path_length)
+      unsigned int get_plen;
+      unsigned int plen;
+      size_t dsize;
+
+      if (GNUNET_YES == m->header_only)
+      {
+        get_plen = 0;
+        plen = 0;
+        dsize = 0;
+      }
+      else
+      {
+        get_plen = get_path_length;
+        plen = put_path_length;
+        dsize = size;
+      }
+      msize = dsize;
+      msize += (get_plen + plen)
                * sizeof (struct GNUNET_PeerIdentity);
       msize += sizeof (struct GNUNET_DHT_MonitorGetRespMessage);
       msize += sizeof (struct PendingMessage);
@@ -1356,26 +1647,25 @@ GDS_CLIENTS_process_get_resp (enum GNUNET_BLOCK_Type type,
       mmsg->header.size = htons (msize - sizeof (struct PendingMessage));
       mmsg->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_MONITOR_GET_RESP);
       mmsg->type = htonl(type);
-      mmsg->put_path_length = htonl(put_path_length);
-      mmsg->get_path_length = htonl(get_path_length);
+      mmsg->put_path_length = htonl(plen);
+      mmsg->get_path_length = htonl(get_plen);
       path = (struct GNUNET_PeerIdentity *) &mmsg[1];
-      if (put_path_length > 0)
+      if (plen > 0)
       {
         memcpy (path, put_path,
-                put_path_length * sizeof (struct GNUNET_PeerIdentity));
-        path = &path[put_path_length];
+                plen * sizeof (struct GNUNET_PeerIdentity));
+        path = &path[plen];
       }
-      if (get_path_length > 0)
+      if (get_plen > 0)
         memcpy (path, get_path,
-                get_path_length * sizeof (struct GNUNET_PeerIdentity));
+                get_plen * sizeof (struct GNUNET_PeerIdentity));
       mmsg->expiration_time = GNUNET_TIME_absolute_hton(exp);
       memcpy (&mmsg->key, key, sizeof (struct GNUNET_HashCode));
-      if (size > 0)
-        memcpy (&path[get_path_length], data, size);
+      if (dsize > 0)
+        memcpy (&path[get_plen], data, dsize);
       add_pending_message (m->client, pm);
     }
   }
-  GNUNET_free_non_null (cl);
 }
 
 
@@ -1407,33 +1697,25 @@ GDS_CLIENTS_process_put (uint32_t options,
                          size_t size)
 {
   struct ClientMonitorRecord *m;
-  struct ClientList **cl;
-  unsigned int cl_size;
 
-  cl = NULL;
-  cl_size = 0;
+  if (NULL == monitor_head)
+    return;
+  monitor_event_id++;
   for (m = monitor_head; NULL != m; m = m->next)
   {
-    if ((GNUNET_BLOCK_TYPE_ANY == m->type || m->type == type) &&
-        (NULL == m->key ||
-         memcmp (key, m->key, sizeof(struct GNUNET_HashCode)) == 0))
+    if (GNUNET_YES == monitor_match (m, m->put, type, key))
     {
       struct PendingMessage *pm;
       struct GNUNET_DHT_MonitorPutMessage *mmsg;
       struct GNUNET_PeerIdentity *msg_path;
       size_t msize;
-      unsigned int i;
-
-      /* Don't send duplicates */
-      for (i = 0; i < cl_size; i++)
-        if (cl[i] == m->client)
-          break;
-      if (i < cl_size)
-        continue;
-      GNUNET_array_append (cl, cl_size, m->client);
-
-      msize = size;
-      msize += path_length * sizeof (struct GNUNET_PeerIdentity);
+      unsigned int plen;
+      size_t dsize;
+
+      plen = (GNUNET_YES == m->header_only) ? 0 : path_length;
+      dsize = (GNUNET_YES == m->header_only) ? 0 : size;
+      msize = dsize;
+      msize += plen * sizeof (struct GNUNET_PeerIdentity);
       msize += sizeof (struct GNUNET_DHT_MonitorPutMessage);
       msize += sizeof (struct PendingMessage);
       pm = GNUNET_malloc (msize);
@@ -1445,21 +1727,20 @@ GDS_CLIENTS_process_put (uint32_t options,
       mmsg->type = htonl(type);
       mmsg->hop_count = htonl(hop_count);
       mmsg->desired_replication_level = htonl(desired_replication_level);
-      mmsg->put_path_length = htonl(path_length);
+      mmsg->put_path_length = htonl(plen);
       msg_path = (struct GNUNET_PeerIdentity *) &mmsg[1];
-      if (path_length > 0)
+      if (plen > 0)
       {
         memcpy (msg_path, path,
-                path_length * sizeof (struct GNUNET_PeerIdentity));
+                plen * sizeof (struct GNUNET_PeerIdentity));
       }
       mmsg->expiration_time = GNUNET_TIME_absolute_hton(exp);
       memcpy (&mmsg->key, key, sizeof (struct GNUNET_HashCode));
-      if (size > 0)
-        memcpy (&msg_path[path_length], data, size);
+      if (dsize > 0)
+        memcpy (&msg_path[plen], data, dsize);
       add_pending_message (m->client, pm);
     }
   }
-  GNUNET_free_non_null (cl);
 }
 
 
@@ -1474,6 +1755,8 @@ GDS_CLIENTS_init (struct GNUNET_SERVER_Handle *server)
   static struct GNUNET_SERVER_MessageHandler plugin_handlers[] = {
     {&handle_dht_local_put, NULL,
      GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT, 0},
+    {&handle_dht_local_put_batch, NULL,
+     GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_BATCH, 0},
     {&handle_dht_local_get, NULL,
      GNUNET_MESSAGE_TYPE_DHT_CLIENT_GET, 0},
     {&handle_dht_local_get_stop, NULL,
@@ -33,11 +33,293 @@
 #define LOG(kind,...) GNUNET_log_from (kind, "dht-dhtcache",__VA_ARGS__)
 
 
+/**
+ * Largest total size of the results of a key we keep in the hot cache.
+ */
+#define HOT_CACHE_MAX_ENTRY_SIZE (64 * 1024)
+
+/**
+ * Default for how long we serve results from the hot cache before
+ * asking the datacache again.
+ */
+#define HOT_CACHE_DEFAULT_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+
+/**
+ * Result kept in the hot cache.
+ */
+struct HotCacheResult
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct HotCacheResult *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct HotCacheResult *prev;
+
+  /**
+   * When does the result expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Type of the result.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Number of entries in the put path (following this struct).
+   */
+  unsigned int put_path_length;
+
+  /**
+   * Number of bytes of data (following the put path).
+   */
+  size_t data_size;
+
+};
+
+
+/**
+ * All results of the datacache for a key and type, possibly none
+ * (negative entry).
+ */
+struct HotCacheEntry
+{
+  /**
+   * Kept in an LRU DLL.
+   */
+  struct HotCacheEntry *next;
+
+  /**
+   * Kept in an LRU DLL.
+   */
+  struct HotCacheEntry *prev;
+
+  /**
+   * Head of the results.
+   */
+  struct HotCacheResult *results_head;
+
+  /**
+   * Tail of the results.
+   */
+  struct HotCacheResult *results_tail;
+
+  /**
+   * The key of the entry.  Key in #hot_cache_map (not copied).
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Until when may we serve this entry (the fill time plus the TTL,
+   * or the earliest expiration of any of the results)?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Type the results were requested for (can be
+   * #GNUNET_BLOCK_TYPE_ANY).
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Memory used by the entry and its results.
+   */
+  size_t size;
+
+};
+
+
 /**
  * Handle to the datacache service (for inserting/retrieving data)
  */
 static struct GNUNET_DATACACHE_Handle *datacache;
 
+/**
+ * Entries of the hot cache by key.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *hot_cache_map;
+
+/**
+ * Most recently used hot cache entry.
+ */
+static struct HotCacheEntry *hot_cache_head;
+
+/**
+ * Least recently used hot cache entry.
+ */
+static struct HotCacheEntry *hot_cache_tail;
+
+/**
+ * Memory used by the hot cache.
+ */
+static unsigned long long hot_cache_size;
+
+/**
+ * Maximum memory used by the hot cache, 0 to disable it.
+ */
+static unsigned long long hot_cache_quota;
+
+/**
+ * How long do we serve results from the hot cache?
+ */
+static struct GNUNET_TIME_Relative hot_cache_ttl;
+
+
+/**
+ * Remove an entry from the hot cache.
+ *
+ * @param he the entry to remove
+ */
+static void
+hot_cache_remove (struct HotCacheEntry *he)
+{
+  struct HotCacheResult *hr;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (hot_cache_map,
+                                                       &he->key,
+                                                       he));
+  GNUNET_CONTAINER_DLL_remove (hot_cache_head, hot_cache_tail, he);
+  while (NULL != (hr = he->results_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (he->results_head, he->results_tail, hr);
+    GNUNET_free (hr);
+  }
+  hot_cache_size -= he->size;
+  GNUNET_free (he);
+}
+
+
+/**
+ * Remove all hot cache entries for a key, called when new data
+ * is stored under the key.
+ *
+ * @param cls NULL
+ * @param key the key
+ * @param value the `struct HotCacheEntry` to remove
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+hot_cache_invalidate (void *cls,
+                      const struct GNUNET_HashCode *key,
+                      void *value)
+{
+  struct HotCacheEntry *he = value;
+
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# hot cache entries invalidated"),
+                            1, GNUNET_NO);
+  hot_cache_remove (he);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Closure for #hot_cache_find().
+ */
+struct HotCacheFindContext
+{
+  /**
+   * The type we are looking for.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Where to store the entry found.
+   */
+  struct HotCacheEntry *he;
+};
+
+
+/**
+ * Find the hot cache entry for a type.
+ *
+ * @param cls the `struct HotCacheFindContext`
+ * @param key the key
+ * @param value a `struct HotCacheEntry` for the key
+ * @return #GNUNET_NO if the entry was found
+ */
+static int
+hot_cache_find (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  struct HotCacheFindContext *fc = cls;
+  struct HotCacheEntry *he = value;
+
+  if (he->type != fc->type)
+    return GNUNET_OK;
+  fc->he = he;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Add a result to a hot cache entry that is being filled.
+ *
+ * @param he the entry
+ * @param exp when does the result expire?
+ * @param type the type of the result
+ * @param size number of bytes in @a data
+ * @param data the result
+ * @param put_path_length number of peers in @a put_path
+ * @param put_path path the result took on put
+ * @return #GNUNET_OK on success, #GNUNET_NO if the entry got too big
+ */
+static int
+hot_cache_add_result (struct HotCacheEntry *he,
+                      struct GNUNET_TIME_Absolute exp,
+                      enum GNUNET_BLOCK_Type type,
+                      size_t size,
+                      const void *data,
+                      unsigned int put_path_length,
+                      const struct GNUNET_PeerIdentity *put_path)
+{
+  struct HotCacheResult *hr;
+  size_t rsize;
+
+  rsize = sizeof (struct HotCacheResult) +
+      put_path_length * sizeof (struct GNUNET_PeerIdentity) + size;
+  if (he->size + rsize > HOT_CACHE_MAX_ENTRY_SIZE)
+    return GNUNET_NO;
+  hr = GNUNET_malloc (rsize);
+  hr->expiration = exp;
+  hr->type = type;
+  hr->put_path_length = put_path_length;
+  hr->data_size = size;
+  memcpy (&hr[1], put_path,
+          put_path_length * sizeof (struct GNUNET_PeerIdentity));
+  memcpy (((char *) &hr[1]) +
+          put_path_length * sizeof (struct GNUNET_PeerIdentity),
+          data, size);
+  GNUNET_CONTAINER_DLL_insert_tail (he->results_head, he->results_tail, hr);
+  he->size += rsize;
+  hot_cache_size += rsize;
+  he->expiration = GNUNET_TIME_absolute_min (he->expiration, exp);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Make room in the hot cache.
+ */
+static void
+hot_cache_trim ()
+{
+  while ((hot_cache_size > hot_cache_quota) && (NULL != hot_cache_tail))
+  {
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop ("# hot cache entries evicted"),
+                              1, GNUNET_NO);
+    hot_cache_remove (hot_cache_tail);
+  }
+}
+
 
 /**
  * Handle a datum we've received from another peer.  Cache if
@@ -73,6 +355,9 @@ GDS_DATACACHE_handle_put (struct GNUNET_TIME_Absolute expiration,
     GNUNET_break (0);
     return;
   }
+  if (NULL != hot_cache_map)
+    GNUNET_CONTAINER_multihashmap_get_multiple (hot_cache_map, key,
+                                                &hot_cache_invalidate, NULL);
   /* Put size is actual data size plus struct overhead plus path length (if any) */
   GNUNET_STATISTICS_update (GDS_stats,
                             gettext_noop ("# ITEMS stored in datacache"), 1,
@@ -128,13 +413,23 @@ struct GetRequestContext
    * Return value to give back.
    */
   enum GNUNET_BLOCK_EvaluationResult eval;
+
+  /**
+   * Hot cache entry we are filling, NULL if none.
+   */
+  struct HotCacheEntry *fill;
+
+  /**
+   * Set once the evaluation returned #GNUNET_BLOCK_EVALUATION_OK_LAST.
+   */
+  int done;
 };
 
 
 /**
- * Iterator for local get request results,
+ * Evaluate a local result for a get request and pass it on.
  *
- * @param cls closure for iterator, a `struct GetRequestContext`
+ * @param cls closure, a `struct GetRequestContext`
  * @param exp when does this value expire?
  * @param key the key this data is stored under
  * @param size the size of the data identified by key
@@ -146,14 +441,14 @@ struct GetRequestContext
  * to stop iteration.
  */
 static int
-datacache_get_iterator (void *cls,
-                        const struct GNUNET_HashCode *key,
-                        size_t size,
-                        const char *data,
-                        enum GNUNET_BLOCK_Type type,
-			struct GNUNET_TIME_Absolute exp,
-			unsigned int put_path_length,
-			const struct GNUNET_PeerIdentity *put_path)
+process_result (void *cls,
+                const struct GNUNET_HashCode *key,
+                size_t size,
+                const char *data,
+                enum GNUNET_BLOCK_Type type,
+                struct GNUNET_TIME_Absolute exp,
+                unsigned int put_path_length,
+                const struct GNUNET_PeerIdentity *put_path)
 {
   struct GetRequestContext *ctx = cls;
   enum GNUNET_BLOCK_EvaluationResult eval;
@@ -234,6 +529,90 @@ datacache_get_iterator (void *cls,
 }
 
 
+/**
+ * Iterator for local get request results from the datacache.  Passes
+ * the result to #process_result() and, if we are filling a hot cache
+ * entry, records it.  While filling, the iteration is not stopped
+ * early so that the entry gets complete.
+ *
+ * @param cls closure for iterator, a `struct GetRequestContext`
+ * @param exp when does this value expire?
+ * @param key the key this data is stored under
+ * @param size the size of the data identified by key
+ * @param data the actual data
+ * @param type the type of the @a data
+ * @param put_path_length number of peers in @a put_path
+ * @param put_path path the reply took on put
+ * @return #GNUNET_OK to continue iteration, anything else
+ * to stop iteration.
+ */
+static int
+datacache_get_iterator (void *cls,
+                        const struct GNUNET_HashCode *key,
+                        size_t size,
+                        const char *data,
+                        enum GNUNET_BLOCK_Type type,
+			struct GNUNET_TIME_Absolute exp,
+			unsigned int put_path_length,
+			const struct GNUNET_PeerIdentity *put_path)
+{
+  struct GetRequestContext *ctx = cls;
+  int ret;
+
+  ret = GNUNET_OK;
+  if (GNUNET_NO == ctx->done)
+  {
+    ret = process_result (ctx, key, size, data, type, exp,
+                          put_path_length, put_path);
+    if (GNUNET_OK != ret)
+      ctx->done = GNUNET_YES;
+  }
+  if (NULL == ctx->fill)
+    return ret;
+  if (GNUNET_OK !=
+      hot_cache_add_result (ctx->fill, exp, type, size, data,
+                            put_path_length, put_path))
+  {
+    /* too big for the hot cache, do not cache the key */
+    hot_cache_remove (ctx->fill);
+    ctx->fill = NULL;
+    return ret;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Answer a GET request from a hot cache entry.
+ *
+ * @param ctx the request
+ * @param he the entry
+ * @return number of results passed on
+ */
+static unsigned int
+hot_cache_process (struct GetRequestContext *ctx,
+                   struct HotCacheEntry *he)
+{
+  struct HotCacheResult *hr;
+  unsigned int r;
+
+  r = 0;
+  for (hr = he->results_head; NULL != hr; hr = hr->next)
+  {
+    r++;
+    if (GNUNET_OK !=
+        process_result (ctx, &he->key, hr->data_size,
+                        ((const char *) &hr[1]) +
+                        hr->put_path_length * sizeof (struct GNUNET_PeerIdentity),
+                        hr->type, hr->expiration,
+                        hr->put_path_length,
+                        (const struct GNUNET_PeerIdentity *) &hr[1]))
+      break;
+  }
+  return r;
+}
+
+
 /**
  * Handle a GET request we've received from another peer.
  *
@@ -254,20 +633,65 @@ GDS_DATACACHE_handle_get (const struct GNUNET_HashCode *key,
                           uint32_t reply_bf_mutator)
 {
   struct GetRequestContext ctx;
+  struct HotCacheFindContext fc;
   unsigned int r;
 
   if (NULL == datacache)
     return GNUNET_BLOCK_EVALUATION_REQUEST_VALID;
-  GNUNET_STATISTICS_update (GDS_stats,
-                            gettext_noop ("# GET requests given to datacache"),
-                            1,
-                            GNUNET_NO);
   ctx.eval = GNUNET_BLOCK_EVALUATION_REQUEST_VALID;
   ctx.key = *key;
   ctx.xquery = xquery;
   ctx.xquery_size = xquery_size;
   ctx.reply_bf = reply_bf;
   ctx.reply_bf_mutator = reply_bf_mutator;
+  ctx.fill = NULL;
+  ctx.done = GNUNET_NO;
+  if (NULL != hot_cache_map)
+  {
+    fc.type = type;
+    fc.he = NULL;
+    GNUNET_CONTAINER_multihashmap_get_multiple (hot_cache_map, key,
+                                                &hot_cache_find, &fc);
+    if ( (NULL != fc.he) &&
+         (0 == GNUNET_TIME_absolute_get_remaining (fc.he->expiration).rel_value_us) )
+    {
+      hot_cache_remove (fc.he);
+      fc.he = NULL;
+    }
+    if (NULL != fc.he)
+    {
+      GNUNET_STATISTICS_update (GDS_stats,
+                                (NULL == fc.he->results_head)
+                                ? gettext_noop ("# GET requests answered by hot cache (negative)")
+                                : gettext_noop ("# GET requests answered by hot cache"),
+                                1,
+                                GNUNET_NO);
+      GNUNET_CONTAINER_DLL_remove (hot_cache_head, hot_cache_tail, fc.he);
+      GNUNET_CONTAINER_DLL_insert (hot_cache_head, hot_cache_tail, fc.he);
+      r = hot_cache_process (&ctx, fc.he);
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Hot cache GET for key %s completed (%d). %u results found.\n",
+           GNUNET_h2s (key),
+           ctx.eval,
+           r);
+      return ctx.eval;
+    }
+    /* start filling an entry */
+    ctx.fill = GNUNET_new (struct HotCacheEntry);
+    ctx.fill->key = *key;
+    ctx.fill->type = type;
+    ctx.fill->size = sizeof (struct HotCacheEntry);
+    ctx.fill->expiration = GNUNET_TIME_relative_to_absolute (hot_cache_ttl);
+    GNUNET_CONTAINER_DLL_insert (hot_cache_head, hot_cache_tail, ctx.fill);
+    GNUNET_CONTAINER_multihashmap_put (hot_cache_map, &ctx.fill->key,
+                                       ctx.fill,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+    hot_cache_size += ctx.fill->size;
+  }
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# GET requests given to datacache"),
+                            1,
+                            GNUNET_NO);
   r = GNUNET_DATACACHE_get (datacache,
                             key,
                             type,
@@ -278,6 +702,13 @@ GDS_DATACACHE_handle_get (const struct GNUNET_HashCode *key,
        GNUNET_h2s (key),
        ctx.eval,
        r);
+  if (NULL != ctx.fill)
+  {
+    hot_cache_trim ();
+    GNUNET_STATISTICS_set (GDS_stats,
+                           gettext_noop ("# bytes in hot cache"),
+                           hot_cache_size, GNUNET_NO);
+  }
   return ctx.eval;
 }
 
@@ -289,6 +720,20 @@ void
 GDS_DATACACHE_init ()
 {
   datacache = GNUNET_DATACACHE_create (GDS_cfg, "dhtcache");
+  if (NULL == datacache)
+    return;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (GDS_cfg, "dhtcache",
+                                           "HOT_CACHE_SIZE",
+                                           &hot_cache_quota))
+    hot_cache_quota = 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (GDS_cfg, "dhtcache",
+                                           "HOT_CACHE_TTL",
+                                           &hot_cache_ttl))
+    hot_cache_ttl = HOT_CACHE_DEFAULT_TTL;
+  if (0 != hot_cache_quota)
+    hot_cache_map = GNUNET_CONTAINER_multihashmap_create (1024, GNUNET_YES);
 }
 
 
@@ -298,6 +743,13 @@ GDS_DATACACHE_init ()
 void
 GDS_DATACACHE_done ()
 {
+  if (NULL != hot_cache_map)
+  {
+    while (NULL != hot_cache_head)
+      hot_cache_remove (hot_cache_head);
+    GNUNET_CONTAINER_multihashmap_destroy (hot_cache_map);
+    hot_cache_map = NULL;
+  }
   if (NULL != datacache)
   {
     GNUNET_DATACACHE_destroy (datacache);
@@ -94,6 +94,11 @@
  */
 #define GET_TIMEOUT GNUNET_TIME_relative_multiply(GNUNET_TIME_UNIT_MINUTES, 2)
 
+/**
+ * Capability bit: the peer handles #GNUNET_MESSAGE_TYPE_DHT_P2P_PUT_BATCH.
+ */
+#define DHT_CAPABILITY_PUT_BATCH 1
+
 /**
  * Hello address expiration
  */
@@ -159,6 +164,104 @@ struct PeerPutMessage
 };
 
 
+/**
+ * P2P PUT message carrying several records for the same next hop.
+ */
+struct PeerPutBatchMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_DHT_P2P_PUT_BATCH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Processing options
+   */
+  uint32_t options GNUNET_PACKED;
+
+  /**
+   * Hop count
+   */
+  uint32_t hop_count GNUNET_PACKED;
+
+  /**
+   * Replication level for all records
+   */
+  uint32_t desired_replication_level GNUNET_PACKED;
+
+  /**
+   * Length of the PUT path that follows (if tracked).
+   */
+  uint32_t put_path_length GNUNET_PACKED;
+
+  /**
+   * Number of records after the PUT path.
+   */
+  uint32_t record_count GNUNET_PACKED;
+
+  /**
+   * Bloomfilter (for peer identities) to stop circular routes
+   */
+  char bloomfilter[DHT_BLOOM_SIZE];
+
+  /* put path (if tracked), shared by all records */
+
+  /* record_count 'struct PeerPutBatchRecord' */
+
+};
+
+
+/**
+ * P2P message sent to each neighbour on connect, announcing the
+ * optional messages we support.  Peers that do not know this message
+ * never receive it from core, so we only use optional messages with
+ * neighbours that sent it to us.
+ */
+struct PeerCapabilitiesMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_DHT_P2P_CAPABILITIES
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Bitmask of DHT_CAPABILITY_* flags.
+   */
+  uint32_t capabilities GNUNET_PACKED;
+
+};
+
+
+/**
+ * Record in a P2P PUT batch message.
+ */
+struct PeerPutBatchRecord
+{
+  /**
+   * Content type.
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Number of bytes of payload following the record.
+   */
+  uint32_t data_size GNUNET_PACKED;
+
+  /**
+   * When does the content expire?
+   */
+  struct GNUNET_TIME_AbsoluteNBO expiration_time;
+
+  /**
+   * The key we are storing under.
+   */
+  struct GNUNET_HashCode key;
+
+  /* Payload */
+
+};
+
+
 /**
  * P2P Result message
  */
@@ -340,6 +443,23 @@ struct PeerInfo
    */
   struct GNUNET_PeerIdentity id;
 
+  /**
+   * Hash of @e id, used for all routing decisions.
+   */
+  struct GNUNET_HashCode phash;
+
+  /**
+   * Our leaf in the #peer_trie, NULL if the peer is beyond the
+   * bucket size and thus not used for routing.
+   */
+  struct PeerTrieNode *leaf;
+
+  /**
+   * DHT_CAPABILITY_* flags the peer announced, 0 until (and unless)
+   * we received its #GNUNET_MESSAGE_TYPE_DHT_P2P_CAPABILITIES.
+   */
+  uint32_t capabilities;
+
 #if 0
   /**
    * What is the average latency for replies received?
@@ -377,6 +497,33 @@ struct PeerBucket
 };
 
 
+/**
+ * Node of the crit-bit trie indexing the peers we route to by the hash
+ * of their identity.  Inner nodes branch on a bit (in the order of
+ * #GNUNET_CRYPTO_hash_get_bit, where differences in lower bits count
+ * stronger for the distance), leaves refer to a peer.  A depth-first
+ * walk that always visits the child matching the key first thus
+ * yields the peers by increasing distance to the key.
+ */
+struct PeerTrieNode
+{
+  /**
+   * Children of an inner node, indexed by the value of @e bit.
+   */
+  struct PeerTrieNode *child[2];
+
+  /**
+   * Peer of a leaf, NULL for inner nodes.
+   */
+  struct PeerInfo *peer;
+
+  /**
+   * Bit an inner node branches on.
+   */
+  unsigned int bit;
+};
+
+
 /**
  * Do we cache all results that we are routing in the local datacache?
  */
@@ -408,6 +555,12 @@ static int disable_try_connect;
  */
 static struct PeerBucket k_buckets[MAX_BUCKETS];
 
+/**
+ * Root of the trie of the peers we route to, that is the first
+ * #bucket_size peers of each of the #k_buckets.
+ */
+static struct PeerTrieNode *peer_trie;
+
 /**
  * Hash map of all known peers, for easy removal from k_buckets on disconnect.
  */
@@ -468,6 +621,180 @@ find_bucket (const struct GNUNET_HashCode *hc)
 }
 
 
+/**
+ * Add a peer to the #peer_trie.
+ *
+ * @param pi peer to add
+ */
+static void
+peer_trie_insert (struct PeerInfo *pi)
+{
+  struct PeerTrieNode *leaf;
+  struct PeerTrieNode *inner;
+  struct PeerTrieNode *pos;
+  struct PeerTrieNode **link;
+  unsigned int crit;
+  int b;
+
+  GNUNET_assert (NULL == pi->leaf);
+  leaf = GNUNET_new (struct PeerTrieNode);
+  leaf->peer = pi;
+  pi->leaf = leaf;
+  if (NULL == peer_trie)
+  {
+    peer_trie = leaf;
+    return;
+  }
+  /* find the first bit in which we differ from the existing peers */
+  pos = peer_trie;
+  while (NULL == pos->peer)
+    pos = pos->child[GNUNET_CRYPTO_hash_get_bit (&pi->phash, pos->bit)];
+  crit = GNUNET_CRYPTO_hash_matching_bits (&pi->phash, &pos->peer->phash);
+  GNUNET_assert (crit < MAX_BUCKETS);
+  /* and branch there */
+  link = &peer_trie;
+  while ((NULL == (*link)->peer) && ((*link)->bit < crit))
+    link = &(*link)->child[GNUNET_CRYPTO_hash_get_bit (&pi->phash,
+                                                       (*link)->bit)];
+  b = GNUNET_CRYPTO_hash_get_bit (&pi->phash, crit);
+  inner = GNUNET_new (struct PeerTrieNode);
+  inner->bit = crit;
+  inner->child[b] = leaf;
+  inner->child[1 - b] = *link;
+  *link = inner;
+}
+
+
+/**
+ * Remove a peer from the #peer_trie.
+ *
+ * @param pi peer to remove
+ */
+static void
+peer_trie_remove (struct PeerInfo *pi)
+{
+  struct PeerTrieNode **link;
+  struct PeerTrieNode **parent;
+  struct PeerTrieNode *inner;
+
+  parent = NULL;
+  link = &peer_trie;
+  while (NULL == (*link)->peer)
+  {
+    parent = link;
+    link = &(*link)->child[GNUNET_CRYPTO_hash_get_bit (&pi->phash,
+                                                       (*link)->bit)];
+  }
+  GNUNET_assert (*link == pi->leaf);
+  if (NULL == parent)
+  {
+    peer_trie = NULL;
+  }
+  else
+  {
+    /* replace the parent by the sibling */
+    inner = *parent;
+    *parent = inner->child[(inner->child[0] == pi->leaf) ? 1 : 0];
+    GNUNET_free (inner);
+  }
+  GNUNET_free (pi->leaf);
+  pi->leaf = NULL;
+}
+
+
+/**
+ * Closure for #peer_trie_closest().
+ */
+struct ClosestPeersContext
+{
+  /**
+   * Key we are looking for peers close to.
+   */
+  const struct GNUNET_HashCode *key;
+
+  /**
+   * Peers to skip, can be NULL.
+   */
+  const struct GNUNET_CONTAINER_BloomFilter *bloom;
+
+  /**
+   * Where to store the peers found.
+   */
+  struct PeerInfo **targets;
+
+  /**
+   * Size of @e targets.
+   */
+  unsigned int max;
+
+  /**
+   * Number of peers stored in @e targets.
+   */
+  unsigned int found;
+};
+
+
+/**
+ * Walk a subtree of the #peer_trie by increasing distance to the key
+ * until enough peers were found.
+ *
+ * @param node subtree to walk
+ * @param ctx the search
+ */
+static void
+peer_trie_closest (const struct PeerTrieNode *node,
+                   struct ClosestPeersContext *ctx)
+{
+  int b;
+
+  if (ctx->found == ctx->max)
+    return;
+  if (NULL != node->peer)
+  {
+    if ((NULL != ctx->bloom) &&
+        (GNUNET_YES ==
+         GNUNET_CONTAINER_bloomfilter_test (ctx->bloom, &node->peer->phash)))
+      return;
+    ctx->targets[ctx->found++] = node->peer;
+    return;
+  }
+  b = GNUNET_CRYPTO_hash_get_bit (ctx->key, node->bit);
+  peer_trie_closest (node->child[b], ctx);
+  peer_trie_closest (node->child[1 - b], ctx);
+}
+
+
+/**
+ * Get the peers we route to that are closest to the key and not in
+ * the given bloomfilter.
+ *
+ * @param key the key we are selecting peers for
+ * @param bloom peers to exclude, can be NULL
+ * @param max maximum number of peers to select
+ * @param targets array of length @a max to store the selection in,
+ *        ordered by increasing distance to @a key
+ * @return number of peers stored in @a targets
+ */
+static unsigned int
+get_closest_peers (const struct GNUNET_HashCode *key,
+                   const struct GNUNET_CONTAINER_BloomFilter *bloom,
+                   unsigned int max,
+                   struct PeerInfo **targets)
+{
+  struct ClosestPeersContext ctx;
+
+  if (NULL == peer_trie)
+    return 0;
+  ctx.key = key;
+  ctx.bloom = bloom;
+  ctx.targets = targets;
+  ctx.max = max;
+  ctx.found = 0;
+  peer_trie_closest (peer_trie, &ctx);
+  return ctx.found;
+}
+
+
 /**
  * Let GNUnet core know that we like the given peer.
  *
@@ -482,20 +809,16 @@ update_core_preference (void *cls,
   uint64_t preference;
   unsigned int matching;
   int bucket;
-  struct GNUNET_HashCode phash;
 
   peer->preference_task = NULL;
   if ((tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN) != 0)
     return;
-  GNUNET_CRYPTO_hash (&peer->id,
-		      sizeof (struct GNUNET_PeerIdentity),
-		      &phash);
   matching =
       GNUNET_CRYPTO_hash_matching_bits (&my_identity_hash,
-                                        &phash);
+                                        &peer->phash);
   if (matching >= 64)
     matching = 63;
-  bucket = find_bucket (&phash);
+  bucket = find_bucket (&peer->phash);
   if (bucket == GNUNET_SYSERR)
     preference = 0;
   else
@@ -631,6 +954,15 @@ send_find_peer_message (void *cls,
 }
 
 
+/**
+ * Transmit all messages in the peer's message queue.
+ *
+ * @param peer message queue to process
+ */
+static void
+process_peer_queue (struct PeerInfo *peer);
+
+
 /**
  * Method called whenever a peer connects.
  *
@@ -642,6 +974,8 @@ handle_core_connect (void *cls, const struct GNUNET_PeerIdentity *peer)
 {
   struct PeerInfo *ret;
   struct GNUNET_HashCode phash;
+  struct P2PPendingMessage *pending;
+  struct PeerCapabilitiesMessage *pcm;
   int peer_bucket;
 
   /* Check for connect to self message */
@@ -670,9 +1004,12 @@ handle_core_connect (void *cls, const struct GNUNET_PeerIdentity *peer)
   ret->distance = distance;
 #endif
   ret->id = *peer;
+  ret->phash = phash;
   GNUNET_CONTAINER_DLL_insert_tail (k_buckets[peer_bucket].head,
                                     k_buckets[peer_bucket].tail, ret);
   k_buckets[peer_bucket].peers_size++;
+  if (k_buckets[peer_bucket].peers_size <= bucket_size)
+    peer_trie_insert (ret);
   closest_bucket = GNUNET_MAX (closest_bucket, peer_bucket);
   if ((peer_bucket > 0) && (k_buckets[peer_bucket].peers_size <= bucket_size))
   {
@@ -684,6 +1021,19 @@ handle_core_connect (void *cls, const struct GNUNET_PeerIdentity *peer)
                  GNUNET_CONTAINER_multipeermap_put (all_known_peers,
                                                     peer, ret,
                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  /* tell the peer which optional messages we understand */
+  pending = GNUNET_malloc (sizeof (struct P2PPendingMessage) +
+                           sizeof (struct PeerCapabilitiesMessage));
+  pending->importance = 0;    /* FIXME */
+  pending->timeout = GNUNET_TIME_UNIT_FOREVER_ABS;
+  pcm = (struct PeerCapabilitiesMessage *) &pending[1];
+  pending->msg = &pcm->header;
+  pcm->header.size = htons (sizeof (struct PeerCapabilitiesMessage));
+  pcm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_CAPABILITIES);
+  pcm->capabilities = htonl (DHT_CAPABILITY_PUT_BATCH);
+  GNUNET_CONTAINER_DLL_insert_tail (ret->head, ret->tail, pending);
+  ret->pending_count++;
+  process_peer_queue (ret);
   if (1 == GNUNET_CONTAINER_multipeermap_size (all_known_peers) &&
       (GNUNET_YES != disable_try_connect))
   {
@@ -706,8 +1056,10 @@ handle_core_disconnect (void *cls,
   struct PeerInfo *to_remove;
   int current_bucket;
   struct P2PPendingMessage *pos;
+  struct PeerInfo *next;
   unsigned int discarded;
-  struct GNUNET_HashCode phash;
+  unsigned int i;
+  int routed;
 
   /* Check for disconnect from self message */
   if (0 == memcmp (&my_identity, peer, sizeof (struct GNUNET_PeerIdentity)))
@@ -733,15 +1085,24 @@ handle_core_disconnect (void *cls,
     GNUNET_SCHEDULER_cancel (to_remove->preference_task);
     to_remove->preference_task = NULL;
   }
-  GNUNET_CRYPTO_hash (peer,
-		      sizeof (struct GNUNET_PeerIdentity),
-		      &phash);
-  current_bucket = find_bucket (&phash);
+  current_bucket = find_bucket (&to_remove->phash);
   GNUNET_assert (current_bucket >= 0);
+  routed = (NULL != to_remove->leaf);
+  if (routed)
+    peer_trie_remove (to_remove);
   GNUNET_CONTAINER_DLL_remove (k_buckets[current_bucket].head,
                                k_buckets[current_bucket].tail, to_remove);
   GNUNET_assert (k_buckets[current_bucket].peers_size > 0);
   k_buckets[current_bucket].peers_size--;
+  if ((routed) && (0 < bucket_size) &&
+      (k_buckets[current_bucket].peers_size >= bucket_size))
+  {
+    /* the first peer beyond the bucket size takes the free place */
+    next = k_buckets[current_bucket].head;
+    for (i = 1; i < bucket_size; i++)
+      next = next->next;
+    peer_trie_insert (next);
+  }
   while ((closest_bucket > 0) && (k_buckets[closest_bucket].peers_size == 0))
     closest_bucket--;
 
@@ -821,6 +1182,10 @@ core_transmit_notify (void *cls, size_t size, void *buf)
                               gettext_noop
                               ("# Bytes transmitted to other peers"), msize,
                               GNUNET_NO);
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop
+                              ("# P2P messages transmitted"), 1,
+                              GNUNET_NO);
     memcpy (&cbuf[off], pending->msg, msize);
     off += msize;
     peer->pending_count--;
@@ -925,68 +1290,6 @@ get_forward_count (uint32_t hop_count, uint32_t target_replication)
 }
 
 
-/**
- * Compute the distance between have and target as a 32-bit value.
- * Differences in the lower bits must count stronger than differences
- * in the higher bits.
- *
- * @param target
- * @param have
- * @return 0 if have==target, otherwise a number
- *           that is larger as the distance between
- *           the two hash codes increases
- */
-static unsigned int
-get_distance (const struct GNUNET_HashCode *target,
-	      const struct GNUNET_HashCode *have)
-{
-  unsigned int bucket;
-  unsigned int msb;
-  unsigned int lsb;
-  unsigned int i;
-
-  /* We have to represent the distance between two 2^9 (=512)-bit
-   * numbers as a 2^5 (=32)-bit number with "0" being used for the
-   * two numbers being identical; furthermore, we need to
-   * guarantee that a difference in the number of matching
-   * bits is always represented in the result.
-   *
-   * We use 2^32/2^9 numerical values to distinguish between
-   * hash codes that have the same LSB bit distance and
-   * use the highest 2^9 bits of the result to signify the
-   * number of (mis)matching LSB bits; if we have 0 matching
-   * and hence 512 mismatching LSB bits we return -1 (since
-   * 512 itself cannot be represented with 9 bits) */
-
-  /* first, calculate the most significant 9 bits of our
-   * result, aka the number of LSBs */
-  bucket = GNUNET_CRYPTO_hash_matching_bits (target, have);
-  /* bucket is now a value between 0 and 512 */
-  if (bucket == 512)
-    return 0;                   /* perfect match */
-  if (bucket == 0)
-    return (unsigned int) -1;   /* LSB differs; use max (if we did the bit-shifting
-                                 * below, we'd end up with max+1 (overflow)) */
-
-  /* calculate the most significant bits of the final result */
-  msb = (512 - bucket) << (32 - 9);
-  /* calculate the 32-9 least significant bits of the final result by
-   * looking at the differences in the 32-9 bits following the
-   * mismatching bit at 'bucket' */
-  lsb = 0;
-  for (i = bucket + 1;
-       (i < sizeof (struct GNUNET_HashCode) * 8) && (i < bucket + 1 + 32 - 9); i++)
-  {
-    if (GNUNET_CRYPTO_hash_get_bit (target, i) !=
-        GNUNET_CRYPTO_hash_get_bit (have, i))
-      lsb |= (1 << (bucket + 32 - 9 - i));      /* first bit set will be 10,
-                                                 * last bit set will be 31 -- if
-                                                 * i does not reach 512 first... */
-  }
-  return msb | lsb;
-}
-
-
 /**
  * Check whether my identity is closer than any known peers.  If a
  * non-null bloomfilter is given, check if this is the closest peer
@@ -1001,40 +1304,16 @@ static int
 am_closest_peer (const struct GNUNET_HashCode *key,
                  const struct GNUNET_CONTAINER_BloomFilter *bloom)
 {
-  int bits;
-  int other_bits;
-  int bucket_num;
-  int count;
-  struct PeerInfo *pos;
-  struct GNUNET_HashCode phash;
+  struct PeerInfo *closest;
+  unsigned int bits;
 
   if (0 == memcmp (&my_identity_hash, key, sizeof (struct GNUNET_HashCode)))
     return GNUNET_YES;
-  bucket_num = find_bucket (key);
-  GNUNET_assert (bucket_num >= 0);
+  if (0 == get_closest_peers (key, bloom, 1, &closest))
+    return GNUNET_YES;          /* No peers left, we are the closest! */
   bits = GNUNET_CRYPTO_hash_matching_bits (&my_identity_hash, key);
-  pos = k_buckets[bucket_num].head;
-  count = 0;
-  while ((pos != NULL) && (count < bucket_size))
-  {
-    GNUNET_CRYPTO_hash (&pos->id,
-			sizeof (struct GNUNET_PeerIdentity),
-			&phash);
-    if ((bloom != NULL) &&
-        (GNUNET_YES ==
-         GNUNET_CONTAINER_bloomfilter_test (bloom, &phash)))
-    {
-      pos = pos->next;
-      continue;                 /* Skip already checked entries */
-    }
-    other_bits = GNUNET_CRYPTO_hash_matching_bits (&phash, key);
-    if (other_bits > bits)
-      return GNUNET_NO;
-    if (other_bits == bits)     /* We match the same number of bits */
-      return GNUNET_YES;
-    pos = pos->next;
-  }
-  /* No peers closer, we are the closest! */
+  if (GNUNET_CRYPTO_hash_matching_bits (&closest->phash, key) > bits)
+    return GNUNET_NO;
   return GNUNET_YES;
 }
 
@@ -1064,55 +1343,27 @@ select_peer (const struct GNUNET_HashCode * key,
   unsigned int count;
   unsigned int selected;
   struct PeerInfo *pos;
-  unsigned int dist;
-  unsigned int smallest_distance;
   struct PeerInfo *chosen;
-  struct GNUNET_HashCode phash;
 
   if (hops >= GDS_NSE_get ())
   {
-    /* greedy selection (closest peer that is not in bloomfilter) */
-    smallest_distance = UINT_MAX;
-    chosen = NULL;
-    for (bc = 0; bc <= closest_bucket; bc++)
+    /* greedy selection (closest peer, unless it is in the bloomfilter) */
+    if (0 == get_closest_peers (key, NULL, 1, &chosen))
     {
-      pos = k_buckets[bc].head;
-      count = 0;
-      while ((pos != NULL) && (count < bucket_size))
-      {
-	GNUNET_CRYPTO_hash (&pos->id,
-			    sizeof (struct GNUNET_PeerIdentity),
-			    &phash);
-        if ((bloom == NULL) ||
-            (GNUNET_NO ==
-             GNUNET_CONTAINER_bloomfilter_test (bloom, &phash)))
-        {
-          dist = get_distance (key, &phash);
-          if (dist < smallest_distance)
-          {
-            chosen = pos;
-            smallest_distance = dist;
-          }
-        }
-        else
-        {
-          GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                      "Excluded peer `%s' due to BF match in greedy routing for %s\n",
-                      GNUNET_i2s (&pos->id), GNUNET_h2s (key));
-          GNUNET_STATISTICS_update (GDS_stats,
-                                    gettext_noop
-                                    ("# Peers excluded from routing due to Bloomfilter"),
-                                    1, GNUNET_NO);
-          dist = get_distance (key, &phash);
-          if (dist < smallest_distance)
-          {
-            chosen = NULL;
-            smallest_distance = dist;
-          }
-        }
-        count++;
-        pos = pos->next;
-      }
+      chosen = NULL;
+    }
+    else if ((bloom != NULL) &&
+             (GNUNET_YES ==
+              GNUNET_CONTAINER_bloomfilter_test (bloom, &chosen->phash)))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Excluded peer `%s' due to BF match in greedy routing for %s\n",
+                  GNUNET_i2s (&chosen->id), GNUNET_h2s (key));
+      GNUNET_STATISTICS_update (GDS_stats,
+                                gettext_noop
+                                ("# Peers excluded from routing due to Bloomfilter"),
+                                1, GNUNET_NO);
+      chosen = NULL;
     }
     if (NULL == chosen)
       GNUNET_STATISTICS_update (GDS_stats,
@@ -1129,12 +1380,9 @@ select_peer (const struct GNUNET_HashCode * key,
     pos = k_buckets[bc].head;
     while ((pos != NULL) && (count < bucket_size))
     {
-      GNUNET_CRYPTO_hash (&pos->id,
-			  sizeof (struct GNUNET_PeerIdentity),
-			  &phash);
       if ((bloom != NULL) &&
           (GNUNET_YES ==
-           GNUNET_CONTAINER_bloomfilter_test (bloom, &phash)))
+           GNUNET_CONTAINER_bloomfilter_test (bloom, &pos->phash)))
       {
         GNUNET_STATISTICS_update (GDS_stats,
                                   gettext_noop
@@ -1164,12 +1412,9 @@ select_peer (const struct GNUNET_HashCode * key,
   {
     for (pos = k_buckets[bc].head; ((pos != NULL) && (count < bucket_size)); pos = pos->next)
     {
-      GNUNET_CRYPTO_hash (&pos->id,
-			  sizeof (struct GNUNET_PeerIdentity),
-			  &phash);
       if ((bloom != NULL) &&
           (GNUNET_YES ==
-           GNUNET_CONTAINER_bloomfilter_test (bloom, &phash)))
+           GNUNET_CONTAINER_bloomfilter_test (bloom, &pos->phash)))
       {
         continue;               /* Ignore bloomfiltered peers */
       }
@@ -1205,7 +1450,6 @@ get_target_peers (const struct GNUNET_HashCode *key,
   unsigned int off;
   struct PeerInfo **rtargets;
   struct PeerInfo *nxt;
-  struct GNUNET_HashCode nhash;
 
   GNUNET_assert (NULL != bloom);
   ret = get_forward_count (hop_count, target_replication);
@@ -1221,13 +1465,10 @@ get_target_peers (const struct GNUNET_HashCode *key,
     if (NULL == nxt)
       break;
     rtargets[off] = nxt;
-    GNUNET_CRYPTO_hash (&nxt->id,
-			sizeof (struct GNUNET_PeerIdentity),
-			&nhash);
     GNUNET_break (GNUNET_NO ==
                   GNUNET_CONTAINER_bloomfilter_test (bloom,
-                                                     &nhash));
-    GNUNET_CONTAINER_bloomfilter_add (bloom, &nhash);
+                                                     &nxt->phash));
+    GNUNET_CONTAINER_bloomfilter_add (bloom, &nxt->phash);
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Selected %u/%u peers at hop %u for %s (target was %u)\n", off,
@@ -1250,32 +1491,124 @@ get_target_peers (const struct GNUNET_HashCode *key,
 
 
 /**
- * Perform a PUT operation.   Forwards the given request to other
- * peers.   Does not store the data locally.  Does not give the
- * data to local clients.  May do nothing if this is the only
- * peer in the network (or if we are the closest peer in the
- * network).
+ * Queue a PUT message for a neighbour.
  *
+ * @param target neighbour to send the record to
  * @param type type of the block
  * @param options routing options
  * @param desired_replication_level desired replication count
  * @param expiration_time when does the content expire
  * @param hop_count how many hops has this message traversed so far
- * @param bf Bloom filter of peers this PUT has already traversed
+ * @param bf Bloom filter to send along, must contain @a target
  * @param key key for the content
  * @param put_path_length number of entries in @a put_path
  * @param put_path peers this request has traversed so far (if tracked)
  * @param data payload to store
  * @param data_size number of bytes in @a data
- * @return #GNUNET_OK if the request was forwarded, #GNUNET_NO if not
+ * @return #GNUNET_OK if the message was queued,
+ *         #GNUNET_NO if the queue of @a target is full,
+ *         #GNUNET_SYSERR if the record is too big
  */
-int
-GDS_NEIGHBOURS_handle_put (enum GNUNET_BLOCK_Type type,
-                           enum GNUNET_DHT_RouteOption options,
-                           uint32_t desired_replication_level,
-                           struct GNUNET_TIME_Absolute expiration_time,
-                           uint32_t hop_count,
-                           struct GNUNET_CONTAINER_BloomFilter *bf,
+static int
+queue_put (struct PeerInfo *target,
+           enum GNUNET_BLOCK_Type type,
+           enum GNUNET_DHT_RouteOption options,
+           uint32_t desired_replication_level,
+           struct GNUNET_TIME_Absolute expiration_time,
+           uint32_t hop_count,
+           const struct GNUNET_CONTAINER_BloomFilter *bf,
+           const struct GNUNET_HashCode *key,
+           unsigned int put_path_length,
+           const struct GNUNET_PeerIdentity *put_path,
+           const void *data, size_t data_size)
+{
+  struct P2PPendingMessage *pending;
+  struct PeerPutMessage *ppm;
+  struct GNUNET_PeerIdentity *pp;
+  size_t msize;
+
+  msize =
+      put_path_length * sizeof (struct GNUNET_PeerIdentity) + data_size +
+      sizeof (struct PeerPutMessage);
+  if (msize >= GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE)
+  {
+    put_path_length = 0;
+    msize = data_size + sizeof (struct PeerPutMessage);
+  }
+  if (msize >= GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  if (target->pending_count >= MAXIMUM_PENDING_PER_PEER)
+  {
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop ("# P2P messages dropped due to full queue"),
+                              1, GNUNET_NO);
+    return GNUNET_NO;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Routing PUT for %s after %u hops to %s\n", GNUNET_h2s (key),
+              (unsigned int) hop_count, GNUNET_i2s (&target->id));
+  pending = GNUNET_malloc (sizeof (struct P2PPendingMessage) + msize);
+  pending->importance = 0;    /* FIXME */
+  pending->timeout = expiration_time;
+  ppm = (struct PeerPutMessage *) &pending[1];
+  pending->msg = &ppm->header;
+  ppm->header.size = htons (msize);
+  ppm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_PUT);
+  ppm->options = htonl (options);
+  ppm->type = htonl (type);
+  ppm->hop_count = htonl (hop_count + 1);
+  ppm->desired_replication_level = htonl (desired_replication_level);
+  ppm->put_path_length = htonl (put_path_length);
+  ppm->expiration_time = GNUNET_TIME_absolute_hton (expiration_time);
+  GNUNET_break (GNUNET_YES ==
+                GNUNET_CONTAINER_bloomfilter_test (bf,
+                                                   &target->phash));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_get_raw_data (bf,
+                                                            ppm->bloomfilter,
+                                                            DHT_BLOOM_SIZE));
+  ppm->key = *key;
+  pp = (struct GNUNET_PeerIdentity *) &ppm[1];
+  memcpy (pp, put_path,
+          sizeof (struct GNUNET_PeerIdentity) * put_path_length);
+  memcpy (&pp[put_path_length], data, data_size);
+  GNUNET_CONTAINER_DLL_insert_tail (target->head, target->tail, pending);
+  target->pending_count++;
+  process_peer_queue (target);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Perform a PUT operation.   Forwards the given request to other
+ * peers.   Does not store the data locally.  Does not give the
+ * data to local clients.  May do nothing if this is the only
+ * peer in the network (or if we are the closest peer in the
+ * network).
+ *
+ * @param type type of the block
+ * @param options routing options
+ * @param desired_replication_level desired replication count
+ * @param expiration_time when does the content expire
+ * @param hop_count how many hops has this message traversed so far
+ * @param bf Bloom filter of peers this PUT has already traversed
+ * @param key key for the content
+ * @param put_path_length number of entries in @a put_path
+ * @param put_path peers this request has traversed so far (if tracked)
+ * @param data payload to store
+ * @param data_size number of bytes in @a data
+ * @return #GNUNET_OK if the request was forwarded, #GNUNET_NO if not
+ */
+int
+GDS_NEIGHBOURS_handle_put (enum GNUNET_BLOCK_Type type,
+                           enum GNUNET_DHT_RouteOption options,
+                           uint32_t desired_replication_level,
+                           struct GNUNET_TIME_Absolute expiration_time,
+                           uint32_t hop_count,
+                           struct GNUNET_CONTAINER_BloomFilter *bf,
                            const struct GNUNET_HashCode *key,
                            unsigned int put_path_length,
                            struct GNUNET_PeerIdentity *put_path,
@@ -1284,12 +1617,7 @@ GDS_NEIGHBOURS_handle_put (enum GNUNET_BLOCK_Type type,
   unsigned int target_count;
   unsigned int i;
   struct PeerInfo **targets;
-  struct PeerInfo *target;
-  struct P2PPendingMessage *pending;
   size_t msize;
-  struct PeerPutMessage *ppm;
-  struct GNUNET_PeerIdentity *pp;
-  struct GNUNET_HashCode thash;
   unsigned int skip_count;
 
   GNUNET_assert (NULL != bf);
@@ -1330,54 +1658,370 @@ GDS_NEIGHBOURS_handle_put (enum GNUNET_BLOCK_Type type,
                             target_count, GNUNET_NO);
   skip_count = 0;
   for (i = 0; i < target_count; i++)
+    if (GNUNET_OK !=
+        queue_put (targets[i], type, options, desired_replication_level,
+                   expiration_time, hop_count, bf, key,
+                   put_path_length, put_path, data, data_size))
+      skip_count++;
+  GNUNET_free (targets);
+  return (skip_count < target_count) ? GNUNET_OK : GNUNET_NO;
+}
+
+
+/**
+ * Records of a PUT batch going to the same neighbour.
+ */
+struct PutBatchTarget
+{
+  /**
+   * Neighbour to send the records to.
+   */
+  struct PeerInfo *peer;
+
+  /**
+   * Indices of the records in the batch.
+   */
+  unsigned int *records;
+
+  /**
+   * Number of entries in @e records.
+   */
+  unsigned int n;
+};
+
+
+/**
+ * Queue PUT batch messages with the given records for a neighbour, as
+ * many records per message as fit.  Neighbours that did not announce
+ * #DHT_CAPABILITY_PUT_BATCH get one PUT message per record instead.
+ *
+ * @param target neighbour to send to
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param hop_count how many hops has this batch traversed so far
+ * @param bf Bloom filter to send along
+ * @param put_path_length number of entries in @a put_path
+ * @param put_path peers this batch has traversed so far (if tracked)
+ * @param records all records of the batch
+ * @param idx indices of the records to send to @a target
+ * @param n number of entries in @a idx
+ */
+static void
+queue_put_batch (struct PeerInfo *target,
+                 enum GNUNET_DHT_RouteOption options,
+                 uint32_t desired_replication_level,
+                 uint32_t hop_count,
+                 const struct GNUNET_CONTAINER_BloomFilter *bf,
+                 unsigned int put_path_length,
+                 const struct GNUNET_PeerIdentity *put_path,
+                 const struct GDS_PutRecord *records,
+                 const unsigned int *idx,
+                 unsigned int n)
+{
+  struct P2PPendingMessage *pending;
+  struct PeerPutBatchMessage *ppm;
+  struct PeerPutBatchRecord *rec;
+  struct GNUNET_PeerIdentity *pp;
+  struct GNUNET_TIME_Absolute timeout;
+  size_t hsize;
+  size_t msize;
+  size_t rsize;
+  unsigned int first;
+  unsigned int last;
+  unsigned int i;
+  char *off;
+
+  if (0 == (target->capabilities & DHT_CAPABILITY_PUT_BATCH))
+  {
+    for (i = 0; i < n; i++)
+      if (GNUNET_NO ==
+          queue_put (target, records[idx[i]].type, options,
+                     desired_replication_level,
+                     records[idx[i]].expiration_time, hop_count, bf,
+                     records[idx[i]].key, put_path_length, put_path,
+                     records[idx[i]].data, records[idx[i]].data_size))
+        break;                  /* queue full */
+    return;
+  }
+  hsize = sizeof (struct PeerPutBatchMessage) +
+      put_path_length * sizeof (struct GNUNET_PeerIdentity);
+  if (hsize >= GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE / 2)
+  {
+    put_path_length = 0;
+    hsize = sizeof (struct PeerPutBatchMessage);
+  }
+  first = 0;
+  while (first < n)
   {
-    target = targets[i];
+    msize = hsize;
+    timeout = GNUNET_TIME_UNIT_ZERO_ABS;
+    for (last = first; last < n; last++)
+    {
+      rsize = sizeof (struct PeerPutBatchRecord) + records[idx[last]].data_size;
+      if (msize + rsize >= GNUNET_CONSTANTS_MAX_ENCRYPTED_MESSAGE_SIZE)
+        break;
+      msize += rsize;
+      timeout = GNUNET_TIME_absolute_max (timeout,
+                                          records[idx[last]].expiration_time);
+    }
+    if (last == first)
+    {
+      /* record does not fit in a message on its own */
+      GNUNET_break (0);
+      first++;
+      continue;
+    }
     if (target->pending_count >= MAXIMUM_PENDING_PER_PEER)
     {
-      /* skip */
       GNUNET_STATISTICS_update (GDS_stats,
                                 gettext_noop ("# P2P messages dropped due to full queue"),
 				1, GNUNET_NO);
-      skip_count++;
-      continue;
+      break;
     }
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Routing PUT for %s after %u hops to %s\n", GNUNET_h2s (key),
-                (unsigned int) hop_count, GNUNET_i2s (&target->id));
+                "Routing PUT batch of %u records after %u hops to %s\n",
+                last - first, (unsigned int) hop_count,
+                GNUNET_i2s (&target->id));
     pending = GNUNET_malloc (sizeof (struct P2PPendingMessage) + msize);
     pending->importance = 0;    /* FIXME */
-    pending->timeout = expiration_time;
-    ppm = (struct PeerPutMessage *) &pending[1];
+    pending->timeout = timeout;
+    ppm = (struct PeerPutBatchMessage *) &pending[1];
     pending->msg = &ppm->header;
     ppm->header.size = htons (msize);
-    ppm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_PUT);
+    ppm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_PUT_BATCH);
     ppm->options = htonl (options);
-    ppm->type = htonl (type);
     ppm->hop_count = htonl (hop_count + 1);
     ppm->desired_replication_level = htonl (desired_replication_level);
     ppm->put_path_length = htonl (put_path_length);
-    ppm->expiration_time = GNUNET_TIME_absolute_hton (expiration_time);
-    GNUNET_CRYPTO_hash (&target->id,
-			sizeof (struct GNUNET_PeerIdentity),
-			&thash);
-    GNUNET_break (GNUNET_YES ==
-                  GNUNET_CONTAINER_bloomfilter_test (bf,
-                                                     &thash));
+    ppm->record_count = htonl (last - first);
     GNUNET_assert (GNUNET_OK ==
                    GNUNET_CONTAINER_bloomfilter_get_raw_data (bf,
                                                               ppm->bloomfilter,
                                                               DHT_BLOOM_SIZE));
-    ppm->key = *key;
     pp = (struct GNUNET_PeerIdentity *) &ppm[1];
     memcpy (pp, put_path,
             sizeof (struct GNUNET_PeerIdentity) * put_path_length);
-    memcpy (&pp[put_path_length], data, data_size);
+    off = (char *) &pp[put_path_length];
+    for (i = first; i < last; i++)
+    {
+      rec = (struct PeerPutBatchRecord *) off;
+      rec->type = htonl (records[idx[i]].type);
+      rec->data_size = htonl ((uint32_t) records[idx[i]].data_size);
+      rec->expiration_time =
+          GNUNET_TIME_absolute_hton (records[idx[i]].expiration_time);
+      rec->key = *records[idx[i]].key;
+      memcpy (&rec[1], records[idx[i]].data, records[idx[i]].data_size);
+      off += sizeof (struct PeerPutBatchRecord) + records[idx[i]].data_size;
+    }
     GNUNET_CONTAINER_DLL_insert_tail (target->head, target->tail, pending);
     target->pending_count++;
-    process_peer_queue (target);
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop
+                              ("# PUT batch messages queued for transmission"),
+                              1, GNUNET_NO);
+    first = last;
   }
-  GNUNET_free (targets);
-  return (skip_count < target_count) ? GNUNET_OK : GNUNET_NO;
+  process_peer_queue (target);
+}
+
+
+/**
+ * Perform a PUT operation for several records that traversed the same
+ * path so far.  Like #GDS_NEIGHBOURS_handle_put, but records going to
+ * the same neighbour are sent together in batch messages that share one
+ * peer bloomfilter.
+ *
+ * Each record still selects its targets starting from the same filter
+ * (reset from the raw bits in one scratch filter, not allocated per
+ * record).  The filter sent along is the batch filter plus all peers
+ * selected at this hop, so no record is routed back to a sibling.
+ *
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param hop_count how many hops has this batch traversed so far
+ * @param bf Bloom filter of peers this batch has already traversed
+ * @param put_path_length number of entries in put_path
+ * @param put_path peers this batch has traversed so far (if tracked)
+ * @param record_count number of entries in @a records
+ * @param records records to route, their @e forwarded field is set
+ * @return #GNUNET_OK if any record was forwarded, #GNUNET_NO if not
+ */
+int
+GDS_NEIGHBOURS_handle_put_batch (enum GNUNET_DHT_RouteOption options,
+                                 uint32_t desired_replication_level,
+                                 uint32_t hop_count,
+                                 struct GNUNET_CONTAINER_BloomFilter *bf,
+                                 unsigned int put_path_length,
+                                 const struct GNUNET_PeerIdentity *put_path,
+                                 unsigned int record_count,
+                                 struct GDS_PutRecord *records)
+{
+  struct GNUNET_CONTAINER_BloomFilter *rbf;
+  struct PutBatchTarget *batches;
+  struct PeerInfo **targets;
+  char raw[DHT_BLOOM_SIZE];
+  unsigned int batch_count;
+  unsigned int batch_max;
+  unsigned int target_count;
+  unsigned int i;
+  unsigned int j;
+  unsigned int k;
+
+  GNUNET_assert (NULL != bf);
+  if (0 == record_count)
+    return GNUNET_NO;
+  GNUNET_CONTAINER_bloomfilter_add (bf, &my_identity_hash);
+  GNUNET_STATISTICS_update (GDS_stats, gettext_noop ("# PUT requests routed"),
+                            record_count, GNUNET_NO);
+  GNUNET_STATISTICS_update (GDS_stats, gettext_noop ("# PUT batches routed"),
+                            1, GNUNET_NO);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_get_raw_data (bf, raw,
+                                                            DHT_BLOOM_SIZE));
+  rbf = GNUNET_CONTAINER_bloomfilter_copy (bf);
+  batches = NULL;
+  batch_count = 0;
+  batch_max = 0;
+  for (i = 0; i < record_count; i++)
+  {
+    records[i].forwarded = GNUNET_NO;
+    GNUNET_CONTAINER_bloomfilter_clear (rbf);
+    GNUNET_CONTAINER_bloomfilter_or (rbf, raw, DHT_BLOOM_SIZE);
+    target_count =
+        get_target_peers (records[i].key, rbf, hop_count,
+                          desired_replication_level, &targets);
+    if (0 == target_count)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Routing PUT for %s terminates after %u hops at %s\n",
+                  GNUNET_h2s (records[i].key), (unsigned int) hop_count,
+                  GNUNET_i2s (&my_identity));
+      continue;
+    }
+    for (j = 0; j < target_count; j++)
+    {
+      for (k = 0; k < batch_count; k++)
+        if (batches[k].peer == targets[j])
+          break;
+      if (k == batch_count)
+      {
+        if (targets[j]->pending_count >= MAXIMUM_PENDING_PER_PEER)
+        {
+          GNUNET_STATISTICS_update (GDS_stats,
+                                    gettext_noop ("# P2P messages dropped due to full queue"),
+                                    1, GNUNET_NO);
+          continue;
+        }
+        if (batch_count == batch_max)
+          GNUNET_array_grow (batches, batch_max, 2 * batch_max + 4);
+        batches[k].peer = targets[j];
+        batches[k].records = GNUNET_new_array (record_count, unsigned int);
+        batches[k].n = 0;
+        batch_count++;
+      }
+      batches[k].records[batches[k].n++] = i;
+      records[i].forwarded = GNUNET_OK;
+    }
+    GNUNET_free (targets);
+  }
+  GNUNET_CONTAINER_bloomfilter_free (rbf);
+
+  for (k = 0; k < batch_count; k++)
+  {
+    GNUNET_CONTAINER_bloomfilter_add (bf, &batches[k].peer->phash);
+  }
+  for (k = 0; k < batch_count; k++)
+  {
+    queue_put_batch (batches[k].peer, options, desired_replication_level,
+                     hop_count, bf, put_path_length, put_path,
+                     records, batches[k].records, batches[k].n);
+    GNUNET_free (batches[k].records);
+  }
+  GNUNET_array_grow (batches, batch_max, 0);
+  return (0 < batch_count) ? GNUNET_OK : GNUNET_NO;
+}
+
+
+/**
+ * Queue a GET message for a neighbour.
+ *
+ * @param target neighbour to send the request to
+ * @param type type of the requested data
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param hop_count how many hops did this request traverse so far?
+ * @param key key for the content
+ * @param xquery extended query
+ * @param xquery_size number of bytes in @a xquery
+ * @param reply_bf bloomfilter to filter duplicates
+ * @param reply_bf_mutator mutator for @a reply_bf
+ * @param peer_bf filter for peers not to select, must contain @a target
+ * @return #GNUNET_OK if the message was queued,
+ *         #GNUNET_NO if the queue of @a target is full
+ */
+static int
+queue_get (struct PeerInfo *target,
+           enum GNUNET_BLOCK_Type type,
+           enum GNUNET_DHT_RouteOption options,
+           uint32_t desired_replication_level,
+           uint32_t hop_count, const struct GNUNET_HashCode *key,
+           const void *xquery, size_t xquery_size,
+           const struct GNUNET_CONTAINER_BloomFilter *reply_bf,
+           uint32_t reply_bf_mutator,
+           const struct GNUNET_CONTAINER_BloomFilter *peer_bf)
+{
+  struct P2PPendingMessage *pending;
+  struct PeerGetMessage *pgm;
+  size_t reply_bf_size;
+  size_t msize;
+  char *xq;
+
+  if (target->pending_count >= MAXIMUM_PENDING_PER_PEER)
+  {
+    /* skip */
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop ("# P2P messages dropped due to full queue"),
+                              1, GNUNET_NO);
+    return GNUNET_NO;
+  }
+  reply_bf_size = GNUNET_CONTAINER_bloomfilter_get_size (reply_bf);
+  msize = xquery_size + sizeof (struct PeerGetMessage) + reply_bf_size;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Routing GET for %s after %u hops to %s\n", GNUNET_h2s (key),
+              (unsigned int) hop_count, GNUNET_i2s (&target->id));
+  pending = GNUNET_malloc (sizeof (struct P2PPendingMessage) + msize);
+  pending->importance = 0;    /* FIXME */
+  pending->timeout = GNUNET_TIME_relative_to_absolute (GET_TIMEOUT);
+  pgm = (struct PeerGetMessage *) &pending[1];
+  pending->msg = &pgm->header;
+  pgm->header.size = htons (msize);
+  pgm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_GET);
+  pgm->options = htonl (options);
+  pgm->type = htonl (type);
+  pgm->hop_count = htonl (hop_count + 1);
+  pgm->desired_replication_level = htonl (desired_replication_level);
+  pgm->xquery_size = htonl (xquery_size);
+  pgm->bf_mutator = reply_bf_mutator;
+  GNUNET_break (GNUNET_YES ==
+                GNUNET_CONTAINER_bloomfilter_test (peer_bf,
+                                                   &target->phash));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_bloomfilter_get_raw_data (peer_bf,
+                                                            pgm->bloomfilter,
+                                                            DHT_BLOOM_SIZE));
+  pgm->key = *key;
+  xq = (char *) &pgm[1];
+  memcpy (xq, xquery, xquery_size);
+  if (NULL != reply_bf)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_bloomfilter_get_raw_data (reply_bf,
+                                                              &xq
+                                                              [xquery_size],
+                                                              reply_bf_size));
+  GNUNET_CONTAINER_DLL_insert_tail (target->head, target->tail, pending);
+  target->pending_count++;
+  process_peer_queue (target);
+  return GNUNET_OK;
 }
 
 
@@ -1412,13 +2056,8 @@ GDS_NEIGHBOURS_handle_get (enum GNUNET_BLOCK_Type type,
   unsigned int target_count;
   unsigned int i;
   struct PeerInfo **targets;
-  struct PeerInfo *target;
-  struct P2PPendingMessage *pending;
   size_t msize;
-  struct PeerGetMessage *pgm;
-  char *xq;
   size_t reply_bf_size;
-  struct GNUNET_HashCode thash;
   unsigned int skip_count;
 
   GNUNET_assert (NULL != peer_bf);
@@ -1454,61 +2093,90 @@ GDS_NEIGHBOURS_handle_get (enum GNUNET_BLOCK_Type type,
   /* forward request */
   skip_count = 0;
   for (i = 0; i < target_count; i++)
-  {
-    target = targets[i];
-    if (target->pending_count >= MAXIMUM_PENDING_PER_PEER)
-    {
-      /* skip */
-      GNUNET_STATISTICS_update (GDS_stats,
-                                gettext_noop ("# P2P messages dropped due to full queue"),
-				1, GNUNET_NO);
+    if (GNUNET_OK !=
+        queue_get (targets[i], type, options, desired_replication_level,
+                   hop_count, key, xquery, xquery_size, reply_bf,
+                   reply_bf_mutator, peer_bf))
       skip_count++;
-      continue;
-    }
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Routing GET for %s after %u hops to %s\n", GNUNET_h2s (key),
-                (unsigned int) hop_count, GNUNET_i2s (&target->id));
-    pending = GNUNET_malloc (sizeof (struct P2PPendingMessage) + msize);
-    pending->importance = 0;    /* FIXME */
-    pending->timeout = GNUNET_TIME_relative_to_absolute (GET_TIMEOUT);
-    pgm = (struct PeerGetMessage *) &pending[1];
-    pending->msg = &pgm->header;
-    pgm->header.size = htons (msize);
-    pgm->header.type = htons (GNUNET_MESSAGE_TYPE_DHT_P2P_GET);
-    pgm->options = htonl (options);
-    pgm->type = htonl (type);
-    pgm->hop_count = htonl (hop_count + 1);
-    pgm->desired_replication_level = htonl (desired_replication_level);
-    pgm->xquery_size = htonl (xquery_size);
-    pgm->bf_mutator = reply_bf_mutator;
-    GNUNET_CRYPTO_hash (&target->id,
-			sizeof (struct GNUNET_PeerIdentity),
-			&thash);
-    GNUNET_break (GNUNET_YES ==
-                  GNUNET_CONTAINER_bloomfilter_test (peer_bf,
-                                                     &thash));
-    GNUNET_assert (GNUNET_OK ==
-                   GNUNET_CONTAINER_bloomfilter_get_raw_data (peer_bf,
-                                                              pgm->bloomfilter,
-                                                              DHT_BLOOM_SIZE));
-    pgm->key = *key;
-    xq = (char *) &pgm[1];
-    memcpy (xq, xquery, xquery_size);
-    if (NULL != reply_bf)
-      GNUNET_assert (GNUNET_OK ==
-                     GNUNET_CONTAINER_bloomfilter_get_raw_data (reply_bf,
-                                                                &xq
-                                                                [xquery_size],
-                                                                reply_bf_size));
-    GNUNET_CONTAINER_DLL_insert_tail (target->head, target->tail, pending);
-    target->pending_count++;
-    process_peer_queue (target);
-  }
   GNUNET_free (targets);
   return (skip_count < target_count) ? GNUNET_OK : GNUNET_NO;
 }
 
 
+/**
+ * Perform one round of a parallel GET lookup (see
+ * #GNUNET_DHT_RO_PARALLEL_LOOKUP).  Sends the request to the @a alpha
+ * neighbours closest to the key that have not been asked yet, which
+ * then route it greedily.  Does not lookup the key locally.
+ *
+ * @param type type of the requested data
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param alpha number of neighbours to ask in this round
+ * @param key key for the content
+ * @param xquery extended query
+ * @param xquery_size number of bytes in @a xquery
+ * @param reply_bf bloomfilter to filter duplicates
+ * @param reply_bf_mutator mutator for @a reply_bf
+ * @param queried_bf neighbours already asked in earlier rounds;
+ *        the neighbours selected now are added to it
+ * @return #GNUNET_OK if the request was forwarded, #GNUNET_NO if
+ *         there was no neighbour left to ask
+ */
+int
+GDS_NEIGHBOURS_handle_get_parallel (enum GNUNET_BLOCK_Type type,
+                                    enum GNUNET_DHT_RouteOption options,
+                                    uint32_t desired_replication_level,
+                                    unsigned int alpha,
+                                    const struct GNUNET_HashCode *key,
+                                    const void *xquery, size_t xquery_size,
+                                    const struct GNUNET_CONTAINER_BloomFilter *reply_bf,
+                                    uint32_t reply_bf_mutator,
+                                    struct GNUNET_CONTAINER_BloomFilter *queried_bf)
+{
+  struct PeerInfo *targets[alpha];
+  unsigned int target_count;
+  unsigned int skip_count;
+  unsigned int i;
+  uint32_t hop_count;
+
+  GNUNET_assert (NULL != queried_bf);
+  GNUNET_assert (0 < alpha);
+  if (xquery_size + sizeof (struct PeerGetMessage) +
+      GNUNET_CONTAINER_bloomfilter_get_size (reply_bf) >=
+      GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    GNUNET_break (0);
+    return GNUNET_NO;
+  }
+  target_count = get_closest_peers (key, queried_bf, alpha, targets);
+  if (0 == target_count)
+    return GNUNET_NO;
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# parallel GET rounds started"),
+                            1, GNUNET_NO);
+  GNUNET_CONTAINER_bloomfilter_add (queried_bf, &my_identity_hash);
+  for (i = 0; i < target_count; i++)
+  {
+    GNUNET_CONTAINER_bloomfilter_add (queried_bf, &targets[i]->phash);
+  }
+  /* start past the random walk so that the next hops route greedily */
+  hop_count = (uint32_t) GDS_NSE_get ();
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop
+                            ("# GET messages queued for transmission"),
+                            target_count, GNUNET_NO);
+  skip_count = 0;
+  for (i = 0; i < target_count; i++)
+    if (GNUNET_OK !=
+        queue_get (targets[i], type, options, desired_replication_level,
+                   hop_count, key, xquery, xquery_size, reply_bf,
+                   reply_bf_mutator, queried_bf))
+      skip_count++;
+  return (skip_count < target_count) ? GNUNET_OK : GNUNET_NO;
+}
+
+
 /**
  * Handle a reply (route to origin).  Only forwards the reply back to
  * the given peer.  Does not do local caching or forwarding to local
@@ -1615,6 +2283,77 @@ core_init (void *cls,
 }
 
 
+/**
+ * Check that a PUT payload matches its key and, for the types we can
+ * evaluate, that it is a valid block.
+ *
+ * @param type type of the block
+ * @param key key the block is stored under
+ * @param payload the block
+ * @param payload_size number of bytes in @a payload
+ * @return #GNUNET_OK if the block can be accepted,
+ *         #GNUNET_NO if it must be dropped
+ */
+static int
+check_put_block (enum GNUNET_BLOCK_Type type,
+                 const struct GNUNET_HashCode *key,
+                 const void *payload,
+                 size_t payload_size)
+{
+  struct GNUNET_HashCode test_key;
+
+  switch (GNUNET_BLOCK_get_key
+          (GDS_block_context, type, payload, payload_size,
+           &test_key))
+  {
+  case GNUNET_YES:
+    if (0 != memcmp (&test_key, key, sizeof (struct GNUNET_HashCode)))
+    {
+      char *put_s = GNUNET_strdup (GNUNET_h2s_full (key));
+      GNUNET_break_op (0);
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  "PUT with key `%s' for block with key %s\n",
+                  put_s, GNUNET_h2s_full (&test_key));
+      GNUNET_free (put_s);
+      return GNUNET_NO;
+    }
+    break;
+  case GNUNET_NO:
+    GNUNET_break_op (0);
+    return GNUNET_NO;
+  case GNUNET_SYSERR:
+    /* cannot verify, good luck */
+    break;
+  }
+  if (type == GNUNET_BLOCK_TYPE_REGEX) /* FIXME: do for all tpyes */
+  {
+    switch (GNUNET_BLOCK_evaluate (GDS_block_context,
+                                   type,
+                                   GNUNET_BLOCK_EO_NONE,
+                                   NULL,    /* query */
+                                   NULL, 0, /* bloom filer */
+                                   NULL, 0, /* xquery */
+                                   payload, payload_size))
+    {
+    case GNUNET_BLOCK_EVALUATION_OK_MORE:
+    case GNUNET_BLOCK_EVALUATION_OK_LAST:
+      break;
+
+    case GNUNET_BLOCK_EVALUATION_OK_DUPLICATE:
+    case GNUNET_BLOCK_EVALUATION_RESULT_INVALID:
+    case GNUNET_BLOCK_EVALUATION_RESULT_IRRELEVANT:
+    case GNUNET_BLOCK_EVALUATION_REQUEST_VALID:
+    case GNUNET_BLOCK_EVALUATION_REQUEST_INVALID:
+    case GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED:
+    default:
+      GNUNET_break_op (0);
+      return GNUNET_NO;
+    }
+  }
+  return GNUNET_OK;
+}
+
+
 /**
  * Core handler for p2p put requests.
  *
@@ -1637,7 +2376,6 @@ handle_dht_p2p_put (void *cls, const struct GNUNET_PeerIdentity *peer,
   size_t payload_size;
   enum GNUNET_DHT_RouteOption options;
   struct GNUNET_CONTAINER_BloomFilter *bf;
-  struct GNUNET_HashCode test_key;
   struct GNUNET_HashCode phash;
   int forwarded;
 
@@ -1688,54 +2426,9 @@ handle_dht_p2p_put (void *cls, const struct GNUNET_PeerIdentity *peer,
                 );
     GNUNET_free (tmp);
   }
-  switch (GNUNET_BLOCK_get_key
-          (GDS_block_context, ntohl (put->type), payload, payload_size,
-           &test_key))
-  {
-  case GNUNET_YES:
-    if (0 != memcmp (&test_key, &put->key, sizeof (struct GNUNET_HashCode)))
-    {
-      char *put_s = GNUNET_strdup (GNUNET_h2s_full (&put->key));
-      GNUNET_break_op (0);
-      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                  "PUT with key `%s' for block with key %s\n",
-                  put_s, GNUNET_h2s_full (&test_key));
-      GNUNET_free (put_s);
-      return GNUNET_YES;
-    }
-    break;
-  case GNUNET_NO:
-    GNUNET_break_op (0);
+  if (GNUNET_OK != check_put_block (ntohl (put->type), &put->key,
+                                    payload, payload_size))
     return GNUNET_YES;
-  case GNUNET_SYSERR:
-    /* cannot verify, good luck */
-    break;
-  }
-  if (ntohl (put->type) == GNUNET_BLOCK_TYPE_REGEX) /* FIXME: do for all tpyes */
-  {
-    switch (GNUNET_BLOCK_evaluate (GDS_block_context,
-                                   ntohl (put->type),
-                                   GNUNET_BLOCK_EO_NONE,
-                                   NULL,    /* query */
-                                   NULL, 0, /* bloom filer */
-                                   NULL, 0, /* xquery */
-                                   payload, payload_size))
-    {
-    case GNUNET_BLOCK_EVALUATION_OK_MORE:
-    case GNUNET_BLOCK_EVALUATION_OK_LAST:
-      break;
-
-    case GNUNET_BLOCK_EVALUATION_OK_DUPLICATE:
-    case GNUNET_BLOCK_EVALUATION_RESULT_INVALID:
-    case GNUNET_BLOCK_EVALUATION_RESULT_IRRELEVANT:
-    case GNUNET_BLOCK_EVALUATION_REQUEST_VALID:
-    case GNUNET_BLOCK_EVALUATION_REQUEST_INVALID:
-    case GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED:
-    default:
-      GNUNET_break_op (0);
-      return GNUNET_OK;
-    }
-  }
 
   bf = GNUNET_CONTAINER_bloomfilter_init (put->bloomfilter, DHT_BLOOM_SIZE,
                                           GNUNET_CONSTANTS_BLOOMFILTER_K);
@@ -1789,6 +2482,159 @@ handle_dht_p2p_put (void *cls, const struct GNUNET_PeerIdentity *peer,
 }
 
 
+/**
+ * Core handler for p2p put batch requests.
+ *
+ * @param cls closure
+ * @param peer sender of the request
+ * @param message message
+ * @return #GNUNET_OK to keep the connection open,
+ *         #GNUNET_SYSERR to close it (signal serious error)
+ */
+static int
+handle_dht_p2p_put_batch (void *cls, const struct GNUNET_PeerIdentity *peer,
+                          const struct GNUNET_MessageHeader *message)
+{
+  const struct PeerPutBatchMessage *put;
+  const struct PeerPutBatchRecord *rec;
+  const struct GNUNET_PeerIdentity *put_path;
+  struct GDS_PutRecord *records;
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  struct GNUNET_HashCode phash;
+  enum GNUNET_DHT_RouteOption options;
+  const char *off;
+  const char *end;
+  uint32_t putlen;
+  uint32_t record_count;
+  uint32_t data_size;
+  unsigned int n;
+  unsigned int i;
+  uint16_t msize;
+
+  msize = ntohs (message->size);
+  if (msize < sizeof (struct PeerPutBatchMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_YES;
+  }
+  put = (const struct PeerPutBatchMessage *) message;
+  putlen = ntohl (put->put_path_length);
+  record_count = ntohl (put->record_count);
+  if ((msize <
+       sizeof (struct PeerPutBatchMessage) +
+       putlen * sizeof (struct GNUNET_PeerIdentity)) ||
+      (putlen >
+       GNUNET_SERVER_MAX_MESSAGE_SIZE / sizeof (struct GNUNET_PeerIdentity)) ||
+      (0 == record_count) ||
+      (record_count > msize / sizeof (struct PeerPutBatchRecord)))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_YES;
+  }
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# P2P PUT batches received"), 1,
+                            GNUNET_NO);
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# P2P PUT bytes received"), msize,
+                            GNUNET_NO);
+  put_path = (const struct GNUNET_PeerIdentity *) &put[1];
+  options = ntohl (put->options);
+
+  /* parse all records before acting on any of them */
+  records = GNUNET_new_array (record_count, struct GDS_PutRecord);
+  off = (const char *) &put_path[putlen];
+  end = ((const char *) message) + msize;
+  n = 0;
+  for (i = 0; i < record_count; i++)
+  {
+    if ((size_t) (end - off) < sizeof (struct PeerPutBatchRecord))
+      break;
+    rec = (const struct PeerPutBatchRecord *) off;
+    data_size = ntohl (rec->data_size);
+    if ((size_t) (end - off) - sizeof (struct PeerPutBatchRecord) < data_size)
+      break;
+    off += sizeof (struct PeerPutBatchRecord) + data_size;
+    if (GNUNET_OK != check_put_block (ntohl (rec->type), &rec->key,
+                                      &rec[1], data_size))
+      continue;
+    records[n].type = ntohl (rec->type);
+    records[n].expiration_time =
+        GNUNET_TIME_absolute_ntoh (rec->expiration_time);
+    records[n].key = &rec->key;
+    records[n].data = &rec[1];
+    records[n].data_size = data_size;
+    n++;
+  }
+  if ((i != record_count) || (off != end))
+  {
+    GNUNET_break_op (0);
+    GNUNET_free (records);
+    return GNUNET_YES;
+  }
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# P2P PUT requests received"), n,
+                            GNUNET_NO);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "PUT batch of %u records from %s\n",
+              n, GNUNET_i2s (peer));
+
+  GNUNET_CRYPTO_hash (peer, sizeof (struct GNUNET_PeerIdentity), &phash);
+  bf = GNUNET_CONTAINER_bloomfilter_init (put->bloomfilter, DHT_BLOOM_SIZE,
+                                          GNUNET_CONSTANTS_BLOOMFILTER_K);
+  GNUNET_break_op (GNUNET_YES ==
+                   GNUNET_CONTAINER_bloomfilter_test (bf, &phash));
+  {
+    struct GNUNET_PeerIdentity pp[putlen + 1];
+
+    /* extend 'put path' by sender */
+    if (0 != (options & GNUNET_DHT_RO_RECORD_ROUTE))
+    {
+      memcpy (pp, put_path, putlen * sizeof (struct GNUNET_PeerIdentity));
+      pp[putlen] = *peer;
+      putlen++;
+    }
+    else
+      putlen = 0;
+
+    for (i = 0; i < n; i++)
+    {
+      /* give to local clients */
+      GDS_CLIENTS_handle_reply (records[i].expiration_time,
+                                records[i].key, 0, NULL, putlen, pp,
+                                records[i].type,
+                                records[i].data_size, records[i].data);
+      /* store locally */
+      if ((0 != (options & GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE)) ||
+          (am_closest_peer (records[i].key, bf)))
+        GDS_DATACACHE_handle_put (records[i].expiration_time,
+                                  records[i].key, putlen, pp,
+                                  records[i].type,
+                                  records[i].data_size, records[i].data);
+    }
+    /* route to other peers */
+    GDS_NEIGHBOURS_handle_put_batch (options,
+                                     ntohl (put->desired_replication_level),
+                                     ntohl (put->hop_count), bf,
+                                     putlen, pp, n, records);
+    /* notify monitoring clients */
+    for (i = 0; i < n; i++)
+      GDS_CLIENTS_process_put ((GNUNET_OK == records[i].forwarded)
+                               ? options
+                               : options | GNUNET_DHT_RO_LAST_HOP,
+                               records[i].type,
+                               ntohl (put->hop_count),
+                               ntohl (put->desired_replication_level),
+                               putlen, pp,
+                               records[i].expiration_time,
+                               records[i].key,
+                               records[i].data,
+                               records[i].data_size);
+  }
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+  GNUNET_free (records);
+  return GNUNET_YES;
+}
+
+
 /**
  * We have received a FIND PEER request.  Send matching
  * HELLOs back.
@@ -1807,7 +2653,6 @@ handle_find_peer (const struct GNUNET_PeerIdentity *sender,
   struct PeerBucket *bucket;
   struct PeerInfo *peer;
   unsigned int choice;
-  struct GNUNET_HashCode phash;
   struct GNUNET_HashCode mhash;
   const struct GNUNET_HELLO_Message *hello;
 
@@ -1869,8 +2714,7 @@ handle_find_peer (const struct GNUNET_PeerIdentity *sender,
       return;                   /* no non-masked peer available */
     if (peer == NULL)
       peer = bucket->head;
-    GNUNET_CRYPTO_hash (&peer->id, sizeof (struct GNUNET_PeerIdentity), &phash);
-    GNUNET_BLOCK_mingle_hash (&phash, bf_mutator, &mhash);
+    GNUNET_BLOCK_mingle_hash (&peer->phash, bf_mutator, &mhash);
     hello = GDS_HELLO_get (&peer->id);
   }
   while ((hello == NULL) ||
@@ -2048,6 +2892,39 @@ handle_dht_p2p_get (void *cls,
 }
 
 
+/**
+ * Core handler for p2p capability announcements.
+ *
+ * @param cls closure
+ * @param peer peer identity this notification is about
+ * @param message message
+ * @return #GNUNET_YES (do not cut p2p connection)
+ */
+static int
+handle_dht_p2p_capabilities (void *cls, const struct GNUNET_PeerIdentity *peer,
+                             const struct GNUNET_MessageHeader *message)
+{
+  const struct PeerCapabilitiesMessage *pcm;
+  struct PeerInfo *pi;
+
+  if (ntohs (message->size) < sizeof (struct PeerCapabilitiesMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_YES;
+  }
+  pcm = (const struct PeerCapabilitiesMessage *) message;
+  pi = GNUNET_CONTAINER_multipeermap_get (all_known_peers,
+                                          peer);
+  if (NULL == pi)
+  {
+    GNUNET_break (0);
+    return GNUNET_YES;
+  }
+  pi->capabilities = ntohl (pcm->capabilities);
+  return GNUNET_YES;
+}
+
+
 /**
  * Core handler for p2p result messages.
  *
@@ -2213,6 +3090,8 @@ GDS_NEIGHBOURS_init ()
   static struct GNUNET_CORE_MessageHandler core_handlers[] = {
     {&handle_dht_p2p_get, GNUNET_MESSAGE_TYPE_DHT_P2P_GET, 0},
     {&handle_dht_p2p_put, GNUNET_MESSAGE_TYPE_DHT_P2P_PUT, 0},
+    {&handle_dht_p2p_put_batch, GNUNET_MESSAGE_TYPE_DHT_P2P_PUT_BATCH, 0},
+    {&handle_dht_p2p_capabilities, GNUNET_MESSAGE_TYPE_DHT_P2P_CAPABILITIES, 0},
     {&handle_dht_p2p_result, GNUNET_MESSAGE_TYPE_DHT_P2P_RESULT, 0},
     {NULL, 0, 0}
   };
@@ -64,6 +64,70 @@ GDS_NEIGHBOURS_handle_put (enum GNUNET_BLOCK_Type type,
                            const void *data, size_t data_size);
 
 
+/**
+ * Record routed with #GDS_NEIGHBOURS_handle_put_batch.
+ */
+struct GDS_PutRecord
+{
+  /**
+   * Type of the block.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * When does the content expire?
+   */
+  struct GNUNET_TIME_Absolute expiration_time;
+
+  /**
+   * Key for the content.
+   */
+  const struct GNUNET_HashCode *key;
+
+  /**
+   * Payload to store.
+   */
+  const void *data;
+
+  /**
+   * Number of bytes in @e data.
+   */
+  size_t data_size;
+
+  /**
+   * Set to #GNUNET_OK if the record was forwarded, #GNUNET_NO if not.
+   */
+  int forwarded;
+};
+
+
+/**
+ * Perform a PUT operation for several records that traversed the same
+ * path so far.  Like #GDS_NEIGHBOURS_handle_put, but records going to
+ * the same neighbour are sent together in batch messages that share one
+ * peer bloomfilter.
+ *
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param hop_count how many hops has this batch traversed so far
+ * @param bf Bloom filter of peers this batch has already traversed
+ * @param put_path_length number of entries in put_path
+ * @param put_path peers this batch has traversed so far (if tracked)
+ * @param record_count number of entries in @a records
+ * @param records records to route, their @e forwarded field is set
+ * @return #GNUNET_OK if any record was forwarded, #GNUNET_NO if not
+ */
+int
+GDS_NEIGHBOURS_handle_put_batch (enum GNUNET_DHT_RouteOption options,
+                                 uint32_t desired_replication_level,
+                                 uint32_t hop_count,
+                                 struct GNUNET_CONTAINER_BloomFilter *bf,
+                                 unsigned int put_path_length,
+                                 const struct GNUNET_PeerIdentity *put_path,
+                                 unsigned int record_count,
+                                 struct GDS_PutRecord *records);
+
+
 /**
  * Perform a GET operation.  Forwards the given request to other
  * peers.  Does not lookup the key locally.  May do nothing if this is
@@ -94,6 +158,38 @@ GDS_NEIGHBOURS_handle_get (enum GNUNET_BLOCK_Type type,
                            struct GNUNET_CONTAINER_BloomFilter *peer_bf);
 
 
+/**
+ * Perform one round of a parallel GET lookup (see
+ * #GNUNET_DHT_RO_PARALLEL_LOOKUP).  Sends the request to the @a alpha
+ * neighbours closest to the key that have not been asked yet, which
+ * then route it greedily.  Does not lookup the key locally.
+ *
+ * @param type type of the requested data
+ * @param options routing options
+ * @param desired_replication_level desired replication level
+ * @param alpha number of neighbours to ask in this round
+ * @param key key for the content
+ * @param xquery extended query
+ * @param xquery_size number of bytes in @a xquery
+ * @param reply_bf bloomfilter to filter duplicates
+ * @param reply_bf_mutator mutator for @a reply_bf
+ * @param queried_bf neighbours already asked in earlier rounds;
+ *        the neighbours selected now are added to it
+ * @return #GNUNET_OK if the request was forwarded, #GNUNET_NO if
+ *         there was no neighbour left to ask
+ */
+int
+GDS_NEIGHBOURS_handle_get_parallel (enum GNUNET_BLOCK_Type type,
+                                    enum GNUNET_DHT_RouteOption options,
+                                    uint32_t desired_replication_level,
+                                    unsigned int alpha,
+                                    const struct GNUNET_HashCode *key,
+                                    const void *xquery, size_t xquery_size,
+                                    const struct GNUNET_CONTAINER_BloomFilter *reply_bf,
+                                    uint32_t reply_bf_mutator,
+                                    struct GNUNET_CONTAINER_BloomFilter *queried_bf);
+
+
 /**
  * Handle a reply (route to origin).  Only forwards the reply back to
  * other peers waiting for it.  Does not do local caching or
@@ -24,6 +24,7 @@
  * @author Christian Grothoff
  */
 #include "platform.h"
+#include "gnunet_constants.h"
 #include "gnunet-service-dht_neighbours.h"
 #include "gnunet-service-dht_routing.h"
 #include "gnunet-service-dht.h"
@@ -35,48 +36,60 @@
 #define DHT_MAX_RECENT (1024 * 16)
 
 
+/**
+ * Number of bytes of reply bloomfilter we keep in the #recent_bf
+ * arena for each request; larger filters are allocated separately.
+ */
+#define DHT_RECENT_BF_SIZE 32
+
+
 /**
  * Information we keep about all recent GET requests
- * so that we can route replies.
+ * so that we can route replies.  Kept in fixed-size slots of the
+ * #recent_table, which is used as a ring buffer so that the oldest
+ * request is always the next one to be replaced.
  */
 struct RecentRequest
 {
 
   /**
-   * The peer this request was received from.
+   * Key of this request.  Used as the (not copied) key in #recent_map.
    */
-  struct GNUNET_PeerIdentity peer;
+  struct GNUNET_HashCode key;
 
   /**
-   * Key of this request.
+   * Hash over key, peer, type and xquery of this request.  Used as the
+   * (not copied) key in #combine_map.
    */
-  struct GNUNET_HashCode key;
+  struct GNUNET_HashCode request_hash;
 
   /**
-   * Position of this node in the min heap.
+   * The peer this request was received from.
    */
-  struct GNUNET_CONTAINER_HeapNode *heap_node;
+  struct GNUNET_PeerIdentity peer;
 
   /**
-   * Bloomfilter for replies to drop.
+   * extended query (see gnunet_block_lib.h), NULL if
+   * @e xquery_size is zero.
    */
-  struct GNUNET_CONTAINER_BloomFilter *reply_bf;
+  void *xquery;
 
   /**
-   * Type of the requested block.
+   * Reply bloomfilter bits if @e reply_bf_size exceeds
+   * #DHT_RECENT_BF_SIZE, otherwise NULL and the bits are in the
+   * slot of this request in #recent_bf.
    */
-  enum GNUNET_BLOCK_Type type;
+  char *reply_bf_ext;
 
   /**
-   * extended query (see gnunet_block_lib.h).  Allocated at the
-   * end of this struct.
+   * Type of the requested block.
    */
-  const void *xquery;
+  enum GNUNET_BLOCK_Type type;
 
   /**
-   * Number of bytes in xquery.
+   * Request options.
    */
-  size_t xquery_size;
+  enum GNUNET_DHT_RouteOption options;
 
   /**
    * Mutator value for the reply_bf, see gnunet_block_lib.h
@@ -84,23 +97,103 @@ struct RecentRequest
   uint32_t reply_bf_mutator;
 
   /**
-   * Request options.
+   * Number of bytes in the reply bloomfilter, 0 for none.
    */
-  enum GNUNET_DHT_RouteOption options;
+  uint16_t reply_bf_size;
+
+  /**
+   * Number of bytes in xquery.
+   */
+  uint16_t xquery_size;
 
 };
 
 
 /**
- * Recent requests by time inserted.
+ * Table of #DHT_MAX_RECENT recent requests, oldest first starting
+ * at #recent_off.
  */
-static struct GNUNET_CONTAINER_Heap *recent_heap;
+static struct RecentRequest *recent_table;
+
+/**
+ * Reply bloomfilter bits of the requests in #recent_table,
+ * #DHT_RECENT_BF_SIZE bytes per slot.
+ */
+static char *recent_bf;
+
+/**
+ * Slot of the oldest request in #recent_table, which is replaced by
+ * the next request added.
+ */
+static unsigned int recent_off;
+
+/**
+ * Number of slots in use in #recent_table.
+ */
+static unsigned int recent_count;
 
 /**
  * Recently seen requests by key.
  */
 static struct GNUNET_CONTAINER_MultiHashMap *recent_map;
 
+/**
+ * Recently seen requests by their @e request_hash, to combine
+ * requests for the same result from the same peer.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *combine_map;
+
+
+/**
+ * Get the reply bloomfilter bits of a request.
+ *
+ * @param rr the request
+ * @return @e reply_bf_size bytes of bloomfilter
+ */
+static char *
+get_reply_bf (struct RecentRequest *rr)
+{
+  if (NULL != rr->reply_bf_ext)
+    return rr->reply_bf_ext;
+  return &recent_bf[(rr - recent_table) * DHT_RECENT_BF_SIZE];
+}
+
+
+/**
+ * Store a reply bloomfilter for a request.
+ *
+ * @param rr the request
+ * @param bf the bloomfilter, NULL for none
+ */
+static void
+set_reply_bf (struct RecentRequest *rr,
+              const struct GNUNET_CONTAINER_BloomFilter *bf)
+{
+  size_t size;
+
+  size = GNUNET_CONTAINER_bloomfilter_get_size (bf);
+  if (size > UINT16_MAX)
+  {
+    GNUNET_break (0);
+    size = 0;
+  }
+  if ( (NULL != rr->reply_bf_ext) &&
+       (size != rr->reply_bf_size) )
+  {
+    GNUNET_free (rr->reply_bf_ext);
+    rr->reply_bf_ext = NULL;
+  }
+  if ( (size > DHT_RECENT_BF_SIZE) &&
+       (NULL == rr->reply_bf_ext) )
+    rr->reply_bf_ext = GNUNET_malloc (size);
+  rr->reply_bf_size = (uint16_t) size;
+  if (0 != size)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_bloomfilter_get_raw_data (bf,
+                                                              get_reply_bf (rr),
+                                                              size));
+}
+
 
 /**
  * Closure for the 'process' function.
@@ -164,6 +257,7 @@ process (void *cls, const struct GNUNET_HashCode * key, void *value)
 {
   struct ProcessContext *pc = cls;
   struct RecentRequest *rr = value;
+  struct GNUNET_CONTAINER_BloomFilter *reply_bf;
   enum GNUNET_BLOCK_EvaluationResult eval;
   unsigned int gpl;
   unsigned int ppl;
@@ -198,17 +292,29 @@ process (void *cls, const struct GNUNET_HashCode * key, void *value)
   {
     eval_key = key;
   }
+  if (0 == rr->reply_bf_size)
+    reply_bf = NULL;
+  else
+    reply_bf = GNUNET_CONTAINER_bloomfilter_init (get_reply_bf (rr),
+                                                  rr->reply_bf_size,
+                                                  GNUNET_CONSTANTS_BLOOMFILTER_K);
   eval =
       GNUNET_BLOCK_evaluate (GDS_block_context,
                              pc->type,
                              GNUNET_BLOCK_EO_NONE,
                              eval_key,
-                             &rr->reply_bf,
+                             &reply_bf,
                              rr->reply_bf_mutator,
                              rr->xquery,
                              rr->xquery_size,
                              pc->data,
                              pc->data_size);
+  if (NULL != reply_bf)
+  {
+    /* the reply was added to the filter */
+    set_reply_bf (rr, reply_bf);
+    GNUNET_CONTAINER_bloomfilter_free (reply_bf);
+  }
   switch (eval)
   {
   case GNUNET_BLOCK_EVALUATION_OK_MORE:
@@ -312,7 +418,7 @@ GDS_ROUTING_process (enum GNUNET_BLOCK_Type type,
 /**
  * Remove the oldest entry from the DHT routing table.  Must only
  * be called if it is known that there is at least one entry
- * in the heap and hashmap.
+ * in the table.
  */
 static void
 expire_oldest_entry ()
@@ -323,57 +429,54 @@ expire_oldest_entry ()
 			    gettext_noop
 			    ("# Entries removed from routing table"), 1,
 			    GNUNET_NO);
-  recent_req = GNUNET_CONTAINER_heap_peek (recent_heap);
-  GNUNET_assert (recent_req != NULL);
-  GNUNET_CONTAINER_heap_remove_node (recent_req->heap_node);
-  GNUNET_CONTAINER_bloomfilter_free (recent_req->reply_bf);
+  GNUNET_assert (recent_count > 0);
+  recent_req = &recent_table[recent_off];
   GNUNET_assert (GNUNET_YES ==
 		 GNUNET_CONTAINER_multihashmap_remove (recent_map,
 						       &recent_req->key,
 						       recent_req));
-  GNUNET_free (recent_req);
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (combine_map,
+						       &recent_req->request_hash,
+						       recent_req));
+  GNUNET_free_non_null (recent_req->xquery);
+  GNUNET_free_non_null (recent_req->reply_bf_ext);
+  memset (recent_req, 0, sizeof (struct RecentRequest));
+  recent_off = (recent_off + 1) % DHT_MAX_RECENT;
+  recent_count--;
 }
 
 
 /**
- * Try to combine multiple recent requests for the same value
- * (if they come from the same peer).
+ * Try to combine a new request with a recent request for the same
+ * value from the same peer.
  *
- * @param cls the new 'struct RecentRequest' (to discard upon successful combination)
- * @param key the query
- * @param value the existing 'struct RecentRequest' (to update upon successful combination)
- * @return GNUNET_OK (continue to iterate),
- *         GNUNET_SYSERR if the request was successfully combined
+ * @param rr the existing request (to update upon successful combination)
+ * @param reply_bf bloomfilter of the new request
+ * @param reply_bf_mutator mutator for @a reply_bf
  */
-static int
-try_combine_recent (void *cls, const struct GNUNET_HashCode * key, void *value)
+static void
+combine_recent (struct RecentRequest *rr,
+                const struct GNUNET_CONTAINER_BloomFilter *reply_bf,
+                uint32_t reply_bf_mutator)
 {
-  struct RecentRequest *in = cls;
-  struct RecentRequest *rr = value;
+  struct GNUNET_CONTAINER_BloomFilter *bf;
 
-  if ( (0 != memcmp (&in->peer,
-		     &rr->peer,
-		     sizeof (struct GNUNET_PeerIdentity))) ||
-       (in->type != rr->type) ||
-       (in->xquery_size != rr->xquery_size) ||
-       (0 != memcmp (in->xquery,
-		     rr->xquery,
-		     in->xquery_size)) )
-    return GNUNET_OK;
-  if (in->reply_bf_mutator != rr->reply_bf_mutator)
-  {
-    rr->reply_bf_mutator = in->reply_bf_mutator;
-    GNUNET_CONTAINER_bloomfilter_free (rr->reply_bf);
-    rr->reply_bf = in->reply_bf;
-  }
-  else
+  if ( (reply_bf_mutator != rr->reply_bf_mutator) ||
+       (GNUNET_CONTAINER_bloomfilter_get_size (reply_bf) != rr->reply_bf_size) )
   {
-    GNUNET_CONTAINER_bloomfilter_or2 (rr->reply_bf,
-				      in->reply_bf);
-    GNUNET_CONTAINER_bloomfilter_free (in->reply_bf);
+    rr->reply_bf_mutator = reply_bf_mutator;
+    set_reply_bf (rr, reply_bf);
+    return;
   }
-  GNUNET_free (in);
-  return GNUNET_SYSERR;
+  if (0 == rr->reply_bf_size)
+    return;
+  bf = GNUNET_CONTAINER_bloomfilter_copy (reply_bf);
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_CONTAINER_bloomfilter_or (bf, get_reply_bf (rr),
+                                                 rr->reply_bf_size));
+  set_reply_bf (rr, bf);
+  GNUNET_CONTAINER_bloomfilter_free (bf);
 }
 
 
@@ -399,39 +502,71 @@ GDS_ROUTING_add (const struct GNUNET_PeerIdentity *sender,
                  uint32_t reply_bf_mutator)
 {
   struct RecentRequest *recent_req;
+  struct GNUNET_HashCode request_hash;
+  uint32_t type_nbo;
+  char buf[sizeof (struct GNUNET_HashCode) +
+           sizeof (struct GNUNET_PeerIdentity) +
+           sizeof (uint32_t) + xquery_size];
 
-  while (GNUNET_CONTAINER_heap_get_size (recent_heap) >= DHT_MAX_RECENT)
-    expire_oldest_entry ();
+  if (xquery_size > UINT16_MAX)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  type_nbo = htonl ((uint32_t) type);
+  memcpy (buf, key, sizeof (struct GNUNET_HashCode));
+  memcpy (&buf[sizeof (struct GNUNET_HashCode)],
+          sender, sizeof (struct GNUNET_PeerIdentity));
+  memcpy (&buf[sizeof (struct GNUNET_HashCode) +
+               sizeof (struct GNUNET_PeerIdentity)],
+          &type_nbo, sizeof (uint32_t));
+  memcpy (&buf[sizeof (struct GNUNET_HashCode) +
+               sizeof (struct GNUNET_PeerIdentity) + sizeof (uint32_t)],
+          xquery, xquery_size);
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), &request_hash);
   GNUNET_STATISTICS_update (GDS_stats,
                             gettext_noop ("# Entries added to routing table"),
                             1, GNUNET_NO);
-  recent_req = GNUNET_malloc (sizeof (struct RecentRequest) + xquery_size);
-  recent_req->peer = *sender;
-  recent_req->key = *key;
-  recent_req->reply_bf = GNUNET_CONTAINER_bloomfilter_copy (reply_bf);
-  recent_req->type = type;
-  recent_req->options = options;
-  recent_req->xquery = &recent_req[1];
-  memcpy (&recent_req[1], xquery, xquery_size);
-  recent_req->xquery_size = xquery_size;
-  recent_req->reply_bf_mutator = reply_bf_mutator;
-  if (GNUNET_SYSERR ==
-      GNUNET_CONTAINER_multihashmap_get_multiple (recent_map, key,
-						  &try_combine_recent, recent_req))
+  recent_req = GNUNET_CONTAINER_multihashmap_get (combine_map, &request_hash);
+  if ( (NULL != recent_req) &&
+       (0 == memcmp (&recent_req->key, key,
+                     sizeof (struct GNUNET_HashCode))) &&
+       (0 == memcmp (&recent_req->peer, sender,
+                     sizeof (struct GNUNET_PeerIdentity))) &&
+       (recent_req->type == type) &&
+       (recent_req->xquery_size == xquery_size) &&
+       ( (0 == xquery_size) ||
+         (0 == memcmp (recent_req->xquery, xquery, xquery_size)) ) )
   {
+    combine_recent (recent_req, reply_bf, reply_bf_mutator);
     GNUNET_STATISTICS_update (GDS_stats,
                               gettext_noop
                               ("# DHT requests combined"),
                               1, GNUNET_NO);
     return;
   }
-  recent_req->heap_node =
-      GNUNET_CONTAINER_heap_insert (recent_heap, recent_req,
-                                    GNUNET_TIME_absolute_get ().abs_value_us);
-  GNUNET_CONTAINER_multihashmap_put (recent_map, key, recent_req,
+  if (recent_count == DHT_MAX_RECENT)
+    expire_oldest_entry ();
+  recent_req = &recent_table[(recent_off + recent_count) % DHT_MAX_RECENT];
+  recent_count++;
+  recent_req->key = *key;
+  recent_req->request_hash = request_hash;
+  recent_req->peer = *sender;
+  recent_req->type = type;
+  recent_req->options = options;
+  recent_req->xquery_size = (uint16_t) xquery_size;
+  if (0 != xquery_size)
+  {
+    recent_req->xquery = GNUNET_malloc (xquery_size);
+    memcpy (recent_req->xquery, xquery, xquery_size);
+  }
+  recent_req->reply_bf_mutator = reply_bf_mutator;
+  set_reply_bf (recent_req, reply_bf);
+  GNUNET_CONTAINER_multihashmap_put (recent_map, &recent_req->key, recent_req,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  GNUNET_CONTAINER_multihashmap_put (combine_map, &recent_req->request_hash,
+                                     recent_req,
                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
-
-
 }
 
 
@@ -441,8 +576,13 @@ GDS_ROUTING_add (const struct GNUNET_PeerIdentity *sender,
 void
 GDS_ROUTING_init ()
 {
-  recent_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
-  recent_map = GNUNET_CONTAINER_multihashmap_create (DHT_MAX_RECENT * 4 / 3, GNUNET_NO);
+  recent_table = GNUNET_new_array (DHT_MAX_RECENT, struct RecentRequest);
+  recent_bf = GNUNET_malloc (DHT_MAX_RECENT * DHT_RECENT_BF_SIZE);
+  recent_off = 0;
+  recent_count = 0;
+  /* keys live in the (never moved) slots of the table */
+  recent_map = GNUNET_CONTAINER_multihashmap_create (DHT_MAX_RECENT * 4 / 3, GNUNET_YES);
+  combine_map = GNUNET_CONTAINER_multihashmap_create (DHT_MAX_RECENT * 4 / 3, GNUNET_YES);
 }
 
 
@@ -452,14 +592,18 @@ GDS_ROUTING_init ()
 void
 GDS_ROUTING_done ()
 {
-  while (GNUNET_CONTAINER_heap_get_size (recent_heap) > 0)
+  while (recent_count > 0)
     expire_oldest_entry ();
-  GNUNET_assert (0 == GNUNET_CONTAINER_heap_get_size (recent_heap));
-  GNUNET_CONTAINER_heap_destroy (recent_heap);
-  recent_heap = NULL;
   GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (recent_map));
   GNUNET_CONTAINER_multihashmap_destroy (recent_map);
   recent_map = NULL;
+  GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (combine_map));
+  GNUNET_CONTAINER_multihashmap_destroy (combine_map);
+  combine_map = NULL;
+  GNUNET_free (recent_bf);
+  recent_bf = NULL;
+  GNUNET_free (recent_table);
+  recent_table = NULL;
 }
 
 /* end of gnunet-service-dht_routing.c */
@@ -582,6 +582,25 @@ static struct GNUNET_CONTAINER_Heap *trail_heap;
 static struct GNUNET_CORE_Handle *core_api;
 
 
+/**
+ * Send a message to a friend, keeping track of the number of
+ * messages we transmit.
+ *
+ * @param mq message queue of the friend
+ * @param env the message to send
+ */
+static void
+send_to_friend (struct GNUNET_MQ_Handle *mq,
+                struct GNUNET_MQ_Envelope *env)
+{
+  GNUNET_STATISTICS_update (GDS_stats,
+                            gettext_noop ("# P2P messages transmitted"),
+                            1,
+                            GNUNET_NO);
+  GNUNET_MQ_send (mq, env);
+}
+
+
 /**
  * Handle the put request from the client.
  *
@@ -667,7 +686,7 @@ delete_trail (struct Trail *trail,
       env = GNUNET_MQ_msg (tdm,
                            GNUNET_MESSAGE_TYPE_WDHT_TRAIL_DESTROY);
       tdm->trail_id = trail->pred_id;
-      GNUNET_MQ_send (friend->mq,
+      send_to_friend (friend->mq,
                       env);
     }
     GNUNET_CONTAINER_MDLL_remove (pred,
@@ -683,7 +702,7 @@ delete_trail (struct Trail *trail,
       env = GNUNET_MQ_msg (tdm,
                            GNUNET_MESSAGE_TYPE_WDHT_TRAIL_DESTROY);
       tdm->trail_id = trail->pred_id;
-      GNUNET_MQ_send (friend->mq,
+      send_to_friend (friend->mq,
                       env);
     }
     GNUNET_CONTAINER_MDLL_remove (succ,
@@ -769,7 +788,7 @@ forward_message_on_trail (struct FriendInfo *next_target,
   memcpy (&new_path[plen],
           payload,
           payload_len);
-  GNUNET_MQ_send (next_target->mq,
+  send_to_friend (next_target->mq,
                   env);
 }
 
@@ -1023,7 +1042,7 @@ do_random_walk (void *cls,
                        GNUNET_MESSAGE_TYPE_WDHT_RANDOM_WALK);
   rwm->hops_taken = htonl (0);
   rwm->trail_id = trail->succ_id;
-  GNUNET_MQ_send (friend->mq,
+  send_to_friend (friend->mq,
                   env);
   /* clean up 'old' entry (implicitly via trail cleanup) */
   ft = &fingers[walk_layer];
@@ -1203,7 +1222,7 @@ handle_dht_p2p_random_walk (void *cls,
         rwrm->location = f->destination;
       }
     }
-    GNUNET_MQ_send (pred->mq,
+    send_to_friend (pred->mq,
                     env);
   }
   else
@@ -1240,7 +1259,7 @@ handle_dht_p2p_random_walk (void *cls,
     rwm->hops_taken = htons (1 + ntohs (m->hops_taken));
     rwm->layer = m->layer;
     rwm->trail_id = t->succ_id;
-    GNUNET_MQ_send (succ->mq,
+    send_to_friend (succ->mq,
                     env);
   }
   return GNUNET_OK;
@@ -1285,7 +1304,7 @@ handle_dht_p2p_random_walk_response (void *cls,
     rwrm2->reserved = htonl (0);
     rwrm2->location = rwrm->location;
     rwrm2->trail_id = trail->pred_id;
-    GNUNET_MQ_send (pred->mq,
+    send_to_friend (pred->mq,
                     env);
     return GNUNET_OK;
   }
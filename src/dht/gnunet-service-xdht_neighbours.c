@@ -1018,6 +1018,10 @@ core_transmit_notify (void *cls, size_t size, void *buf)
                               ("# Bytes transmitted to other peers"),
                               msize,
                               GNUNET_NO);
+    GNUNET_STATISTICS_update (GDS_stats,
+                              gettext_noop
+                              ("# P2P messages transmitted"), 1,
+                              GNUNET_NO);
     memcpy (&cbuf[off], pending->msg, msize);
     off += msize;
     peer->pending_count--;
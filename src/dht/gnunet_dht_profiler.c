@@ -40,6 +40,12 @@
  */
 #define PUT_PROBABILITY 50
 
+/**
+ * Largest GET path length with its own bucket in the hop count
+ * histogram; longer paths are counted in the last bucket.
+ */
+#define MAX_HISTOGRAM_HOPS 16
+
 #if ENABLE_MALICIOUS
 /**
  * Number of peers which should act as malicious peers
@@ -68,6 +74,27 @@ static char *hosts_file;
  */
 struct ActiveContext;
 
+/**
+ * Traffic counters of a peer, taken from its DHT statistics.
+ */
+struct TrafficCounters
+{
+  /**
+   * Bytes the DHT sent to other peers
+   */
+  uint64_t bytes_out;
+
+  /**
+   * Bytes the DHT received from other peers
+   */
+  uint64_t bytes_in;
+
+  /**
+   * Messages the DHT sent to other peers
+   */
+  uint64_t messages_out;
+};
+
 /**
  * Context to hold data of peer
  */
@@ -94,6 +121,17 @@ struct Context
    */
   struct MaliciousContext *mc;
 #endif
+
+  /**
+   * Traffic counters at the start ([0]) and at the end ([1]) of the
+   * GET phase
+   */
+  struct TrafficCounters traffic[2];
+
+  /**
+   * #GNUNET_YES if churn stopped the DHT service of this peer
+   */
+  int offline;
 };
 
 
@@ -197,6 +235,21 @@ struct ActiveContext
    */
   struct GNUNET_SCHEDULER_Task * delay_task;
 
+  /**
+   * When did the current GET start?
+   */
+  struct GNUNET_TIME_Absolute get_start;
+
+  /**
+   * State of the workload generator of this peer
+   */
+  uint64_t rng;
+
+  /**
+   * Number of operations done in the GET phase
+   */
+  unsigned int n_ops;
+
   /**
    * The size of the @e put_data
    */
@@ -289,6 +342,103 @@ static unsigned int n_gets_fail;
  */
 static unsigned int replication;
 
+/**
+ * Number of operations each active peer does in the GET phase
+ */
+static unsigned int num_ops;
+
+/**
+ * Percentage of the operations in the GET phase which are PUTs
+ */
+static unsigned int put_ratio;
+
+/**
+ * Exponent of the Zipf distribution of key popularity, in hundredths
+ */
+static unsigned int zipf_exponent;
+
+/**
+ * Percentage of passive peers toggling their DHT service per churn round
+ */
+static unsigned int churn_rate;
+
+/**
+ * The delay between churn rounds
+ */
+static struct GNUNET_TIME_Relative delay_churn;
+
+/**
+ * Minimum size of the PUT data
+ */
+static unsigned int min_size;
+
+/**
+ * Maximum size of the PUT data
+ */
+static unsigned int max_size;
+
+/**
+ * Seed of the workload generators
+ */
+static unsigned int seed;
+
+/**
+ * DHT overlay to profile ("dht", "xdht" or "wdht"); NULL for the
+ * configured one
+ */
+static char *overlay;
+
+/**
+ * State of the workload generator used for setting up the scenario
+ */
+static uint64_t setup_rng;
+
+/**
+ * Cumulative distribution of the popularity of the records of the
+ * active peers
+ */
+static double *zipf_cdf;
+
+/**
+ * Latencies of the successful GETs, in microseconds
+ */
+static uint64_t *latencies;
+
+/**
+ * Number of entries in @e latencies
+ */
+static unsigned int n_latencies;
+
+/**
+ * Histogram of the GET path lengths of successful GETs
+ */
+static unsigned int hop_histogram[MAX_HISTOGRAM_HOPS + 1];
+
+/**
+ * Number of active peers which completed all their operations
+ */
+static unsigned int n_finished;
+
+/**
+ * Number of times churn stopped or started the DHT service of a peer
+ */
+static unsigned int n_churn_events;
+
+/**
+ * Task doing churn rounds
+ */
+static struct GNUNET_SCHEDULER_Task *churn_task;
+
+/**
+ * When did the GET phase start?
+ */
+static struct GNUNET_TIME_Absolute get_phase_start;
+
+/**
+ * Which of the traffic counters of the peers are we collecting?
+ */
+static unsigned int traffic_phase;
+
 /**
  * Number of times we try to find the successor circle formation
  */
@@ -310,12 +460,12 @@ static struct GNUNET_TESTBED_Operation *successor_stats_op;
 static struct GNUNET_TESTBED_Peer **testbed_handles;
 
 /**
- * Total number of messages sent by peer.
+ * Total number of bytes sent by peers.
  */
 static uint64_t outgoing_bandwidth;
 
 /**
- * Total number of messages received by peer.
+ * Total number of bytes received by peers.
  */
 static uint64_t incoming_bandwidth;
 
@@ -420,6 +570,102 @@ collect_stats (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
 static void
 start_profiling();
 
+
+/**
+ * Initial state of a workload generator.  All generators derive from
+ * #seed so that a scenario can be repeated against different overlays.
+ *
+ * @param stream number of the generator
+ * @return the state
+ */
+static uint64_t
+workload_seed (unsigned int stream)
+{
+  uint64_t x;
+
+  x = ((uint64_t) seed + 1) * 0x9E3779B97F4A7C15LLU;
+  x ^= ((uint64_t) stream + 1) * 0xBF58476D1CE4E5B9LLU;
+  if (0 == x)
+    x = 1;
+  return x;
+}
+
+
+/**
+ * Draw a number from a workload generator (xorshift64*).
+ *
+ * @param rng state of the generator
+ * @param max upper bound (exclusive), must not be 0
+ * @return a number in [0, @a max)
+ */
+static uint32_t
+workload_random (uint64_t *rng,
+                 uint32_t max)
+{
+  uint64_t x = *rng;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *rng = x;
+  return (uint32_t) ((x * 0x2545F4914F6CDD1DLLU) >> 32) % max;
+}
+
+
+/**
+ * Pick the record to GET, following the Zipf popularity of the
+ * records of the active peers.
+ *
+ * @param ac the active context doing the GET
+ * @return the active context whose record to GET
+ */
+static struct ActiveContext *
+pick_record (struct ActiveContext *ac)
+{
+  double u;
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+
+  u = (double) workload_random (&ac->rng, UINT32_MAX) / (double) UINT32_MAX;
+  lo = 0;
+  hi = n_active - 1;
+  while (lo < hi)
+  {
+    mid = (lo + hi) / 2;
+    if (zipf_cdf[mid] < u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return &a_ac[lo];
+}
+
+
+/**
+ * Compute the cumulative distribution of the record popularity.  The
+ * record of the active peer with rank r is requested with a
+ * probability proportional to 1/(r+1)^s; s = 0 is uniform.
+ */
+static void
+setup_zipf ()
+{
+  double s;
+  double sum;
+  unsigned int cnt;
+
+  s = zipf_exponent / 100.0;
+  zipf_cdf = GNUNET_new_array (n_active, double);
+  sum = 0.0;
+  for (cnt = 0; cnt < n_active; cnt++)
+  {
+    sum += pow (cnt + 1, - s);
+    zipf_cdf[cnt] = sum;
+  }
+  for (cnt = 0; cnt < n_active; cnt++)
+    zipf_cdf[cnt] /= sum;
+}
+
 /**
  * Shutdown task.  Cleanup all resources and operations.
  *
@@ -433,6 +679,11 @@ do_shutdown (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   unsigned int cnt;
 
   in_shutdown = GNUNET_YES;
+  if (NULL != churn_task)
+  {
+    GNUNET_SCHEDULER_cancel (churn_task);
+    churn_task = NULL;
+  }
   if (NULL != a_ctx)
   {
     for (cnt=0; cnt < num_peers; cnt++)
@@ -463,12 +714,73 @@ do_shutdown (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     GNUNET_TESTBED_operation_done (bandwidth_stats_op);
   bandwidth_stats_op = NULL;
   GNUNET_free_non_null (a_ac);
+  GNUNET_free_non_null (zipf_cdf);
+  zipf_cdf = NULL;
+  GNUNET_free_non_null (latencies);
+  latencies = NULL;
 }
 
 
 /**
- * Stats callback. Finish the stats testbed operation and when all stats have
- * been iterated, shutdown the test.
+ * Print the traffic generated by the peers during the GET phase.
+ */
+static void
+report_traffic ()
+{
+  struct TrafficCounters *base;
+  struct TrafficCounters *final;
+  uint64_t out;
+  uint64_t max_out;
+  uint64_t messages;
+  uint64_t secs;
+  unsigned int cnt;
+
+  outgoing_bandwidth = 0;
+  incoming_bandwidth = 0;
+  max_out = 0;
+  messages = 0;
+  for (cnt = 0; cnt < num_peers; cnt++)
+  {
+    base = &a_ctx[cnt].traffic[0];
+    final = &a_ctx[cnt].traffic[1];
+    if ( (final->bytes_out < base->bytes_out) ||
+         (final->bytes_in < base->bytes_in) ||
+         (final->messages_out < base->messages_out) )
+    {
+      GNUNET_break (0);
+      continue;
+    }
+    out = final->bytes_out - base->bytes_out;
+    outgoing_bandwidth += out;
+    incoming_bandwidth += final->bytes_in - base->bytes_in;
+    messages += final->messages_out - base->messages_out;
+    max_out = GNUNET_MAX (max_out, out);
+  }
+  secs = GNUNET_TIME_absolute_get_duration (get_phase_start).rel_value_us
+    / GNUNET_TIME_UNIT_SECONDS.rel_value_us;
+  if (0 == secs)
+    secs = 1;
+  INFO ("# Outgoing bandwidth: %llu\n",
+        (unsigned long long) outgoing_bandwidth);
+  INFO ("# Incoming bandwidth: %llu\n",
+        (unsigned long long) incoming_bandwidth);
+  INFO ("# Per-node outgoing bandwidth: %llu bytes/s (max: %llu bytes/s)\n",
+        (unsigned long long) (outgoing_bandwidth / num_peers / secs),
+        (unsigned long long) (max_out / secs));
+  INFO ("# Per-node incoming bandwidth: %llu bytes/s\n",
+        (unsigned long long) (incoming_bandwidth / num_peers / secs));
+  INFO ("# Messages sent: %llu\n",
+        (unsigned long long) messages);
+  if (0 != n_gets)
+    INFO ("# Messages per lookup: %f\n",
+          (double) messages / (double) n_gets);
+}
+
+
+/**
+ * Stats callback.  Finish the stats testbed operation.  For the
+ * snapshot taken at the start of the GET phase, start the GETs;
+ * otherwise report the traffic and shutdown the test.
  *
  * @param cls closure
  * @param op the operation that has been finished
@@ -480,8 +792,17 @@ bandwidth_stats_cont (void *cls,
                       struct GNUNET_TESTBED_Operation *op,
                       const char *emsg)
 {
-  INFO ("# Outgoing bandwidth: %u\n", outgoing_bandwidth);
-  INFO ("# Incoming bandwidth: %u\n", incoming_bandwidth);
+  if (NULL != emsg)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to collect statistics: %s\n", emsg);
+  if (0 == traffic_phase)
+  {
+    GNUNET_TESTBED_operation_done (bandwidth_stats_op);
+    bandwidth_stats_op = NULL;
+    start_profiling ();
+    return;
+  }
+  report_traffic ();
   GNUNET_SCHEDULER_shutdown ();
 }
 
@@ -507,19 +828,89 @@ bandwidth_stats_iterator (void *cls,
 {
    static const char *s_sent = "# Bytes transmitted to other peers";
    static const char *s_recv = "# Bytes received from other peers";
-
+   static const char *s_msgs = "# P2P messages transmitted";
+   struct TrafficCounters *tc;
+   unsigned int cnt;
+
+   for (cnt = 0; cnt < num_peers; cnt++)
+     if (a_ctx[cnt].peer == peer)
+       break;
+   if (num_peers == cnt)
+     return GNUNET_OK;
+   tc = &a_ctx[cnt].traffic[traffic_phase];
    if (0 == strncmp (s_sent, name, strlen (s_sent)))
-     outgoing_bandwidth = outgoing_bandwidth + value;
+     tc->bytes_out = value;
    else if (0 == strncmp(s_recv, name, strlen (s_recv)))
-     incoming_bandwidth = incoming_bandwidth + value;
+     tc->bytes_in = value;
+   else if (0 == strncmp(s_msgs, name, strlen (s_msgs)))
+     tc->messages_out = value;
 
     return GNUNET_OK;
 }
 
 
+/**
+ * Take a snapshot of the traffic counters of all peers.
+ *
+ * @param phase 0 at the start of the GET phase, 1 at its end
+ */
+static void
+collect_traffic (unsigned int phase)
+{
+  traffic_phase = phase;
+  bandwidth_stats_op = GNUNET_TESTBED_get_statistics (num_peers, testbed_handles,
+                                                      "dht", NULL,
+                                                       bandwidth_stats_iterator,
+                                                       bandwidth_stats_cont, NULL);
+}
+
+
+/**
+ * Compare two latencies, for qsort().
+ *
+ * @param a first latency
+ * @param b second latency
+ * @return -1, 0 or 1
+ */
+static int
+cmp_latency (const void *a,
+             const void *b)
+{
+  uint64_t la = *(const uint64_t *) a;
+  uint64_t lb = *(const uint64_t *) b;
+
+  if (la < lb)
+    return -1;
+  return (la > lb) ? 1 : 0;
+}
+
+
+/**
+ * Print a percentile of the GET latencies.
+ *
+ * @param percentile the percentile to print
+ */
+static void
+report_latency (unsigned int percentile)
+{
+  struct GNUNET_TIME_Relative rel;
+  unsigned int off;
+
+  off = (unsigned int) (((uint64_t) n_latencies * percentile) / 100);
+  if (off >= n_latencies)
+    off = n_latencies - 1;
+  rel.rel_value_us = latencies[off];
+  INFO ("# GET latency p%u: %s\n",
+        percentile,
+        GNUNET_STRINGS_relative_time_to_string (rel, GNUNET_NO));
+}
+
+
 static void
 summarize ()
 {
+  unsigned int cnt;
+
   INFO ("# PUTS made: %u\n", n_puts);
   INFO ("# PUTS succeeded: %u\n", n_puts_ok);
   INFO ("# PUTS failed: %u\n", n_puts_fail);
@@ -528,6 +919,21 @@ summarize ()
   INFO ("# GETS failed: %u\n", n_gets_fail);
   INFO ("# average_put_path_length: %f\n", average_put_path_length);
   INFO ("# average_get_path_length: %f\n", average_get_path_length);
+  INFO ("# churn events: %u\n", n_churn_events);
+  if (0 != n_latencies)
+  {
+    qsort (latencies, n_latencies, sizeof (uint64_t), &cmp_latency);
+    report_latency (50);
+    report_latency (90);
+    report_latency (99);
+    report_latency (100);
+  }
+  for (cnt = 0; cnt <= MAX_HISTOGRAM_HOPS; cnt++)
+    if (0 != hop_histogram[cnt])
+      INFO ("# GETs with %s%u hops: %u\n",
+            (MAX_HISTOGRAM_HOPS == cnt) ? ">=" : "",
+            cnt,
+            hop_histogram[cnt]);
 
   if (NULL == testbed_handles)
   {
@@ -535,13 +941,50 @@ summarize ()
     return;
   }
   /* Collect Stats*/
-  bandwidth_stats_op = GNUNET_TESTBED_get_statistics (n_active, testbed_handles,
-                                                      "dht", NULL,
-                                                       bandwidth_stats_iterator,
-                                                       bandwidth_stats_cont, NULL);
+  collect_traffic (1);
+}
+
+
+/**
+ * Called once an active peer completed all of its operations.  Release
+ * its DHT connection and summarize if profiling is complete.
+ *
+ * @param ac the active context
+ */
+static void
+finish_peer (struct ActiveContext *ac)
+{
+  struct Context *ctx = ac->ctx;
+
+  GNUNET_assert (NULL != ctx->op);
+  GNUNET_TESTBED_operation_done (ctx->op);
+  ctx->op = NULL;
+  if (n_active != ++n_finished)
+    return;
+  if (NULL != churn_task)
+  {
+    GNUNET_SCHEDULER_cancel (churn_task);
+    churn_task = NULL;
+  }
+  if (0 != n_gets_ok)
+  {
+    average_put_path_length = (double)total_put_path_length/(double)n_gets_ok;
+    average_get_path_length = (double)total_get_path_length/(double )n_gets_ok;
+  }
+  summarize ();
 }
 
 
+/**
+ * Task to do the next operation of an active peer in the GET phase.
+ *
+ * @param cls the active context
+ * @param tc the scheduler task context
+ */
+static void
+next_op (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
 /**
  * Task to cancel DHT GET.
  *
@@ -558,18 +1001,10 @@ cancel_get (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   GNUNET_assert (NULL != ac->dht_get);
   GNUNET_DHT_get_stop (ac->dht_get);
   ac->dht_get = NULL;
+  ac->get_ac->nrefs--;
   n_gets_fail++;
   GNUNET_assert (NULL != ctx->op);
-  GNUNET_TESTBED_operation_done (ctx->op);
-  ctx->op = NULL;
-
-  /* If profiling is complete, summarize */
-  if (n_active == n_gets_fail + n_gets_ok)
-  {
-    average_put_path_length = (double)total_put_path_length/(double)n_active;
-    average_get_path_length = (double)total_get_path_length/(double )n_gets_ok;
-    summarize ();
-  }
+  next_op (ac, tc);
 }
 
 
@@ -603,7 +1038,6 @@ get_iter (void *cls,
 {
   struct ActiveContext *ac = cls;
   struct ActiveContext *get_ac = ac->get_ac;
-  struct Context *ctx = ac->ctx;
 
   /* Check the keys of put and get match or not. */
   GNUNET_assert (0 == memcmp (key, &get_ac->hash, sizeof (struct GNUNET_HashCode)));
@@ -615,21 +1049,15 @@ get_iter (void *cls,
   ac->dht_get = NULL;
   if (ac->delay_task != NULL)
     GNUNET_SCHEDULER_cancel (ac->delay_task);
-  ac->delay_task = NULL;
-  GNUNET_assert (NULL != ctx->op);
-  GNUNET_TESTBED_operation_done (ctx->op);
-  ctx->op = NULL;
 
   total_put_path_length = total_put_path_length + (double)put_path_length;
   total_get_path_length = total_get_path_length + (double)get_path_length;
-  DEBUG ("total_put_path_length = %f,put_path \n",total_put_path_length);
-  /* Summarize if profiling is complete */
-  if (n_active == n_gets_fail + n_gets_ok)
-  {
-    average_put_path_length = (double)total_put_path_length/(double)n_active;
-    average_get_path_length = (double)total_get_path_length/(double )n_gets_ok;
-    summarize ();
-  }
+  DEBUG ("total_put_path_length = %u,put_path \n",total_put_path_length);
+  GNUNET_array_append (latencies, n_latencies,
+                       GNUNET_TIME_absolute_get_duration (ac->get_start).rel_value_us);
+  hop_histogram[GNUNET_MIN (get_path_length, MAX_HISTOGRAM_HOPS)]++;
+  /* Not calling next_op() directly, we are within the DHT API */
+  ac->delay_task = GNUNET_SCHEDULER_add_now (&next_op, ac);
 }
 
 
@@ -644,25 +1072,24 @@ delayed_get (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct ActiveContext *ac = cls;
   struct ActiveContext *get_ac;
-  unsigned int r;
 
   ac->delay_task = NULL;
   get_ac = NULL;
   while (1)
   {
-    r = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, n_active);
-    get_ac = &a_ac[r];
+    get_ac = pick_record (ac);
     if (NULL != get_ac->put_data)
       break;
   }
   get_ac->nrefs++;
   ac->get_ac = get_ac;
+  ac->get_start = GNUNET_TIME_absolute_get ();
   DEBUG ("GET_REQUEST_START key %s \n", GNUNET_h2s((struct GNUNET_HashCode *)ac->put_data));
   ac->dht_get = GNUNET_DHT_get_start (ac->dht,
                                       GNUNET_BLOCK_TYPE_TEST,
                                       &get_ac->hash,
                                       1, /* replication level */
-                                      GNUNET_DHT_RO_NONE,
+                                      GNUNET_DHT_RO_RECORD_ROUTE,
                                       NULL, 0, /* extended query and size */
                                       get_iter, ac); /* GET iterator and closure
                                                         */
@@ -735,14 +1162,18 @@ delayed_put (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct ActiveContext *ac = cls;
 
+  uint8_t *data;
+  unsigned int cnt;
+
   ac->delay_task = NULL;
-  /* Generate and DHT PUT some random data */
-  ac->put_data_size = 16;       /* minimum */
-  ac->put_data_size += GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-                                                 (63*1024));
+  /* Generate and DHT PUT some data, reproducible from the seed */
+  ac->put_data_size = min_size;
+  ac->put_data_size += workload_random (&ac->rng,
+                                        max_size - min_size + 1);
   ac->put_data = GNUNET_malloc (ac->put_data_size);
-  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
-                              ac->put_data, ac->put_data_size);
+  data = ac->put_data;
+  for (cnt = 0; cnt < ac->put_data_size; cnt++)
+    data[cnt] = (uint8_t) workload_random (&ac->rng, 256);
   GNUNET_CRYPTO_hash (ac->put_data, ac->put_data_size, &ac->hash);
   DEBUG ("PUT_REQUEST_START key %s \n", GNUNET_h2s((struct GNUNET_HashCode *)ac->put_data));
   ac->dht_put = GNUNET_DHT_put (ac->dht, &ac->hash,
@@ -758,6 +1189,69 @@ delayed_put (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 }
 
 
+/**
+ * Continuation of a PUT done in the GET phase.  Proceed with the
+ * next operation.
+ *
+ * @param cls the active context
+ * @param success #GNUNET_OK if the PUT was transmitted,
+ *                #GNUNET_NO on timeout,
+ *                #GNUNET_SYSERR on disconnect from service
+ *                after the PUT message was transmitted
+ *                (so we don't know if it was received or not)
+ */
+static void
+refresh_put_cont (void *cls, int success)
+{
+  struct ActiveContext *ac = cls;
+
+  ac->dht_put = NULL;
+  if (GNUNET_OK == success)
+    n_puts_ok++;
+  else
+    n_puts_fail++;
+  /* Not calling next_op() directly, we are within the DHT API */
+  ac->delay_task = GNUNET_SCHEDULER_add_now (&next_op, ac);
+}
+
+
+/**
+ * Task to do the next operation of an active peer in the GET phase:
+ * either PUT our record again or GET a record.
+ *
+ * @param cls the active context
+ * @param tc the scheduler task context
+ */
+static void
+next_op (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct ActiveContext *ac = cls;
+
+  ac->delay_task = NULL;
+  if (num_ops == ac->n_ops)
+  {
+    finish_peer (ac);
+    return;
+  }
+  ac->n_ops++;
+  if (workload_random (&ac->rng, 100) >= put_ratio)
+  {
+    delayed_get (ac, tc);
+    return;
+  }
+  ac->dht_put = GNUNET_DHT_put (ac->dht, &ac->hash,
+                                replication,
+                                GNUNET_DHT_RO_RECORD_ROUTE,
+                                GNUNET_BLOCK_TYPE_TEST,
+                                ac->put_data_size,
+                                ac->put_data,
+                                GNUNET_TIME_UNIT_FOREVER_ABS,
+                                timeout,
+                                &refresh_put_cont, ac);
+  n_puts++;
+}
+
+
 /**
  * Connection to DHT has been established.  Call the delay task.
  *
@@ -805,7 +1299,7 @@ dht_connected (void *cls,
       delay_get.rel_value_us +
       GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
                                 delay_get.rel_value_us);
-    ac->delay_task = GNUNET_SCHEDULER_add_delayed (peer_delay_get, &delayed_get, ac);
+    ac->delay_task = GNUNET_SCHEDULER_add_delayed (peer_delay_get, &next_op, ac);
     break;
   }
   }
@@ -829,6 +1323,74 @@ dht_connect (void *cls, const struct GNUNET_CONFIGURATION_Handle *cfg)
 }
 
 
+/**
+ * Callback called when churn stopped or started the DHT service of a
+ * peer.
+ *
+ * @param cls the context of the peer
+ * @param op the operation that has been finished
+ * @param emsg error message in case the operation has failed; will be NULL if
+ *          operation has executed successfully.
+ */
+static void
+churn_done (void *cls,
+            struct GNUNET_TESTBED_Operation *op,
+            const char *emsg)
+{
+  struct Context *ctx = cls;
+
+  GNUNET_assert (ctx->op == op);
+  GNUNET_TESTBED_operation_done (ctx->op);
+  ctx->op = NULL;
+  if (NULL != emsg)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Churn failed: %s\n", emsg);
+    return;
+  }
+  ctx->offline = (GNUNET_YES == ctx->offline) ? GNUNET_NO : GNUNET_YES;
+  n_churn_events++;
+}
+
+
+/**
+ * Task doing a churn round: every passive peer stops or restarts its
+ * DHT service with a probability of #churn_rate percent.
+ *
+ * @param cls NULL
+ * @param tc scheduler task context
+ */
+static void
+do_churn (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Context *ctx;
+  unsigned int cnt;
+
+  churn_task = NULL;
+  for (cnt = 0; cnt < num_peers; cnt++)
+  {
+    ctx = &a_ctx[cnt];
+    if ( (NULL != ctx->ac) ||
+#if ENABLE_MALICIOUS
+         (NULL != ctx->mc) ||
+#endif
+         (NULL != ctx->op) )
+      continue;
+    if (workload_random (&setup_rng, 100) >= churn_rate)
+      continue;
+    ctx->op = GNUNET_TESTBED_peer_manage_service (ctx,
+                                                  ctx->peer,
+                                                  "dht",
+                                                  &churn_done,
+                                                  ctx,
+                                                  (GNUNET_YES == ctx->offline)
+                                                  ? 1 : 0);
+  }
+  churn_task = GNUNET_SCHEDULER_add_delayed (delay_churn,
+                                             &do_churn, NULL);
+}
+
+
 /**
  * Adapter function called to destroy a connection to
  * a service.
@@ -857,12 +1419,14 @@ dht_disconnect (void *cls, void *op_result)
       return;
     /* Start GETs if all PUTs have been made */
     mode = MODE_GET;
-    //(void) GNUNET_SCHEDULER_add_now (&call_start_profiling, NULL);
-    start_profiling ();
+    get_phase_start = GNUNET_TIME_absolute_get ();
+    if (0 != churn_rate)
+      churn_task = GNUNET_SCHEDULER_add_delayed (delay_churn,
+                                                 &do_churn, NULL);
+    /* start_profiling() once the traffic counters are known */
+    collect_traffic (0);
     return;
   case MODE_GET:
-    if ((n_gets_ok + n_gets_fail) != n_active)
-      return;
     break;
   }
 }
@@ -1297,6 +1861,7 @@ test_run (void *cls,
   }
   INFO ("%u peers started\n", num_peers);
   a_ctx = GNUNET_malloc (sizeof (struct Context) * num_peers);
+  setup_rng = workload_seed (UINT_MAX);
 
   /* select the peers which actively participate in profiling */
   n_active = num_peers * PUT_PROBABILITY / 100;
@@ -1344,7 +1909,7 @@ test_run (void *cls,
   ac_cnt = 0;
   for (cnt = 0; cnt < num_peers && ac_cnt < n_active; cnt++)
   {
-    if ((GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, 100) >=
+    if ((workload_random (&setup_rng, 100) >=
         PUT_PROBABILITY))
       continue;
 
@@ -1355,10 +1920,17 @@ test_run (void *cls,
 
     a_ctx[cnt].ac = &a_ac[ac_cnt];
     a_ac[ac_cnt].ctx = &a_ctx[cnt];
+    a_ac[ac_cnt].rng = workload_seed (ac_cnt);
     ac_cnt++;
   }
   n_active = ac_cnt;
   INFO ("Active peers: %u\n", n_active);
+  if (0 == n_active)
+  {
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  setup_zipf ();
 
   /* start DHT service on all peers */
   for (cnt = 0; cnt < num_peers; cnt++)
@@ -1394,7 +1966,48 @@ run (void *cls, char *const *args, const char *cfgfile,
                 num_peers);
     return;
   }
+  if ( (0 == min_size) || (min_size > max_size) || (max_size > 63 * 1024) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Invalid record sizes %u-%u\n"),
+                min_size, max_size);
+    return;
+  }
+  if (put_ratio > 100)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Invalid PUT ratio %u\n"),
+                put_ratio);
+    return;
+  }
   cfg = GNUNET_CONFIGURATION_dup (config);
+  if (NULL != overlay)
+  {
+    char *binary;
+
+    if ( (0 != strcmp (overlay, "dht")) &&
+         (0 != strcmp (overlay, "xdht")) &&
+         (0 != strcmp (overlay, "wdht")) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  _("Unknown DHT overlay `%s'\n"),
+                  overlay);
+      GNUNET_CONFIGURATION_destroy (cfg);
+      cfg = NULL;
+      return;
+    }
+    GNUNET_asprintf (&binary, "gnunet-service-%s", overlay);
+    GNUNET_CONFIGURATION_set_value_string (cfg, "dht", "BINARY", binary);
+    GNUNET_free (binary);
+    /* only X-Vine has a successor circle to wait for */
+    if (0 != strcmp (overlay, "xdht"))
+      max_searches = 0;
+  }
+  INFO ("Scenario: overlay %s, seed %u, %u operations per peer, "
+        "%u%% PUTs, Zipf exponent %u/100, churn %u%%, records of %u-%u bytes\n",
+        (NULL != overlay) ? overlay : "(configured)",
+        seed, num_ops, put_ratio, zipf_exponent, churn_rate,
+        min_size, max_size);
   event_mask = 0;
   GNUNET_TESTBED_run (hosts_file, cfg, num_peers, event_mask, NULL,
                       NULL, &test_run, NULL);
@@ -1438,6 +2051,33 @@ main (int argc, char *const *argv)
     {'t', "timeout", "TIMEOUT",
      gettext_noop ("timeout for DHT PUT and GET requests (default: 1 min)"),
      1, &GNUNET_GETOPT_set_relative_time, &timeout},
+    {'O', "overlay", "NAME",
+     gettext_noop ("DHT overlay to profile: dht, xdht or wdht (default: as configured)"),
+     1, &GNUNET_GETOPT_set_string, &overlay},
+    {'S', "seed", "SEED",
+     gettext_noop ("seed of the workload, to repeat a scenario (default: 0)"),
+     1, &GNUNET_GETOPT_set_uint, &seed},
+    {'o', "operations", "COUNT",
+     gettext_noop ("number of operations each active peer does after the PUTs (default: 1)"),
+     1, &GNUNET_GETOPT_set_uint, &num_ops},
+    {'p', "put-ratio", "PERCENT",
+     gettext_noop ("percentage of these operations which are PUTs (default: 0)"),
+     1, &GNUNET_GETOPT_set_uint, &put_ratio},
+    {'z', "zipf", "EXPONENT",
+     gettext_noop ("Zipf exponent of the key popularity in hundredths, 0 for uniform (default: 0)"),
+     1, &GNUNET_GETOPT_set_uint, &zipf_exponent},
+    {'c', "churn", "PERCENT",
+     gettext_noop ("percentage of passive peers stopping or restarting their DHT in each churn round (default: 0)"),
+     1, &GNUNET_GETOPT_set_uint, &churn_rate},
+    {'C', "churn-delay", "DELAY",
+     gettext_noop ("delay between churn rounds (default: 30 sec)"),
+     1, &GNUNET_GETOPT_set_relative_time, &delay_churn},
+    {'m', "min-size", "BYTES",
+     gettext_noop ("minimum size of the records (default: 16)"),
+     1, &GNUNET_GETOPT_set_uint, &min_size},
+    {'M', "max-size", "BYTES",
+     gettext_noop ("maximum size of the records (default: 63 KiB)"),
+     1, &GNUNET_GETOPT_set_uint, &max_size},
     GNUNET_GETOPT_OPTION_END
   };
 
@@ -1449,7 +2089,11 @@ main (int argc, char *const *argv)
   delay_put = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10);
   delay_get = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10);
   timeout = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10);
+  delay_churn = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30);
   replication = 1;      /* default replication */
+  num_ops = 1;
+  min_size = 16;
+  max_size = 63 * 1024;
   rc = 0;
   if (GNUNET_OK !=
       GNUNET_PROGRAM_run (argc, argv, "dht-profiler",
@@ -46,6 +46,49 @@ struct GNUNET_DNS_Register
 };
 
 
+/**
+ * Message from client to DNS service to restrict which requests
+ * it is shown.
+ */
+struct GNUNET_DNS_Filter
+{
+  /**
+   * Header of type #GNUNET_MESSAGE_TYPE_DNS_CLIENT_FILTER
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * NBO encoding of `enum GNUNET_DNS_FilterFlags` for the filter.
+   */
+  uint32_t flags GNUNET_PACKED;
+
+  /**
+   * Number of query types that follow.
+   */
+  uint16_t qtype_count GNUNET_PACKED;
+
+  /**
+   * Number of record types that follow.
+   */
+  uint16_t rtype_count GNUNET_PACKED;
+
+  /**
+   * Number of name suffixes that follow.
+   */
+  uint16_t suffix_count GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint16_t reserved GNUNET_PACKED;
+
+  /* followed by @e qtype_count query types and @e rtype_count
+     record types (uint16_t, NBO), followed by @e suffix_count
+     0-terminated name suffixes */
+
+};
+
+
 /**
  * Message from DNS service to client: please handle a request.
  */
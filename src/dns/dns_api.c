@@ -51,6 +51,30 @@ struct ReplyQueueEntry
 };
 
 
+/**
+ * Filter the client registered, kept so that we can re-send it
+ * after reconnecting.
+ */
+struct FilterEntry
+{
+  /**
+   * Kept in DLL.
+   */
+  struct FilterEntry *next;
+
+  /**
+   * Kept in DLL.
+   */
+  struct FilterEntry *prev;
+
+  /**
+   * Filter message, allocated at the end of this struct.
+   */
+  const struct GNUNET_DNS_Filter *msg;
+
+};
+
+
 /**
  * Handle to identify an individual DNS request.
  */
@@ -116,6 +140,16 @@ struct GNUNET_DNS_Handle
    */
   struct ReplyQueueEntry *rq_tail;
 
+  /**
+   * Head of filters we registered.
+   */
+  struct FilterEntry *filter_head;
+
+  /**
+   * Tail of filters we registered.
+   */
+  struct FilterEntry *filter_tail;
+
   /**
    * Task to reconnect to the service.
    */
@@ -155,6 +189,27 @@ queue_reply (struct GNUNET_DNS_Handle *dh,
 	     struct ReplyQueueEntry *qe);
 
 
+/**
+ * Queue transmission of the given filter to the service.
+ *
+ * @param dh handle with the connection
+ * @param fe filter to transmit
+ */
+static void
+queue_filter (struct GNUNET_DNS_Handle *dh,
+              const struct FilterEntry *fe)
+{
+  struct ReplyQueueEntry *qe;
+  uint16_t msize;
+
+  msize = ntohs (fe->msg->header.size);
+  qe = GNUNET_malloc (sizeof (struct ReplyQueueEntry) + msize);
+  qe->msg = (const struct GNUNET_MessageHeader *) &qe[1];
+  memcpy (&qe[1], fe->msg, msize);
+  queue_reply (dh, qe);
+}
+
+
 /**
  * Reconnect to the DNS service.
  *
@@ -167,6 +222,7 @@ reconnect (void *cls,
 {
   struct GNUNET_DNS_Handle *dh = cls;
   struct ReplyQueueEntry *qe;
+  struct FilterEntry *fe;
   struct GNUNET_DNS_Register *msg;
 
   dh->reconnect_task = NULL;
@@ -182,6 +238,8 @@ reconnect (void *cls,
   msg->header.type = htons (GNUNET_MESSAGE_TYPE_DNS_CLIENT_INIT);
   msg->flags = htonl (dh->flags);
   queue_reply (dh, qe);
+  for (fe = dh->filter_head; NULL != fe; fe = fe->next)
+    queue_filter (dh, fe);
 }
 
 
@@ -500,6 +558,79 @@ GNUNET_DNS_connect (const struct GNUNET_CONFIGURATION_Handle *cfg,
 }
 
 
+/**
+ * Restrict which requests the DNS service shows to this client.
+ * See the header for the matching rules.
+ *
+ * @param dh DNS handle
+ * @param suffix_count number of entries in @a suffixes
+ * @param suffixes name suffixes (without leading dot) to match
+ * @param qtype_count number of entries in @a qtypes
+ * @param qtypes query types to match, see GNUNET_DNSPARSER_TYPE_*
+ * @param rtype_count number of entries in @a rtypes
+ * @param rtypes record types to match, see GNUNET_DNSPARSER_TYPE_*
+ * @param flags options for the filter
+ */
+void
+GNUNET_DNS_add_filter (struct GNUNET_DNS_Handle *dh,
+                       unsigned int suffix_count,
+                       const char *const *suffixes,
+                       unsigned int qtype_count,
+                       const uint16_t *qtypes,
+                       unsigned int rtype_count,
+                       const uint16_t *rtypes,
+                       enum GNUNET_DNS_FilterFlags flags)
+{
+  struct FilterEntry *fe;
+  struct GNUNET_DNS_Filter *msg;
+  uint16_t *types;
+  char *names;
+  size_t msize;
+  size_t slen;
+  unsigned int i;
+
+  msize = sizeof (struct GNUNET_DNS_Filter)
+    + (qtype_count + rtype_count) * sizeof (uint16_t);
+  for (i=0;i<suffix_count;i++)
+    msize += strlen (suffixes[i]) + 1;
+  if ( (msize >= GNUNET_SERVER_MAX_MESSAGE_SIZE) ||
+       (suffix_count > UINT16_MAX) ||
+       (qtype_count > UINT16_MAX) ||
+       (rtype_count > UINT16_MAX) )
+  {
+    GNUNET_break (0);
+    return;
+  }
+  fe = GNUNET_malloc (sizeof (struct FilterEntry) + msize);
+  msg = (struct GNUNET_DNS_Filter *) &fe[1];
+  fe->msg = msg;
+  msg->header.size = htons ((uint16_t) msize);
+  msg->header.type = htons (GNUNET_MESSAGE_TYPE_DNS_CLIENT_FILTER);
+  msg->flags = htonl ((uint32_t) flags);
+  msg->qtype_count = htons ((uint16_t) qtype_count);
+  msg->rtype_count = htons ((uint16_t) rtype_count);
+  msg->suffix_count = htons ((uint16_t) suffix_count);
+  types = (uint16_t *) &msg[1];
+  for (i=0;i<qtype_count;i++)
+    types[i] = htons (qtypes[i]);
+  for (i=0;i<rtype_count;i++)
+    types[qtype_count + i] = htons (rtypes[i]);
+  names = (char *) &types[qtype_count + rtype_count];
+  for (i=0;i<suffix_count;i++)
+  {
+    slen = strlen (suffixes[i]) + 1;
+    memcpy (names, suffixes[i], slen);
+    names += slen;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (dh->filter_head,
+                                    dh->filter_tail,
+                                    fe);
+  /* if we are not connected yet, reconnect() will send it */
+  if (NULL != dh->dns_connection)
+    queue_filter (dh, fe);
+}
+
+
 /**
  * Disconnect from the DNS service.
  *
@@ -508,12 +639,21 @@ GNUNET_DNS_connect (const struct GNUNET_CONFIGURATION_Handle *cfg,
 void
 GNUNET_DNS_disconnect (struct GNUNET_DNS_Handle *dh)
 {
+  struct FilterEntry *fe;
+
   if (NULL != dh->reconnect_task)
   {
     GNUNET_SCHEDULER_cancel (dh->reconnect_task);
     dh->reconnect_task = NULL;
   }
   disconnect (dh);
+  while (NULL != (fe = dh->filter_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (dh->filter_head,
+                                 dh->filter_tail,
+                                 fe);
+    GNUNET_free (fe);
+  }
   /* make sure client has no pending requests left over! */
   GNUNET_assert (0 == dh->pending_requests);
   GNUNET_free (dh);
@@ -197,140 +197,348 @@ GNUNET_DNSPARSER_free_record (struct GNUNET_DNSPARSER_Record *r)
 }
 
 
+/* ********************** DNS parser arena **************** */
+
 /**
- * Parse name inside of a DNS query or record.
+ * Alignment we guarantee for allocations from an arena.
+ */
+#define ARENA_ALIGN 16
+
+/**
+ * Minimum size of a heap chunk the arena allocates once the
+ * caller-supplied memory is exhausted.
+ */
+#define ARENA_CHUNK_SIZE (4 * 1024)
+
+
+/**
+ * Heap chunk used by an arena after the caller-supplied memory
+ * ran out.
+ */
+struct GNUNET_DNSPARSER_ArenaChunk
+{
+  /**
+   * Next chunk in the singly-linked list.
+   */
+  struct GNUNET_DNSPARSER_ArenaChunk *next;
+
+  /**
+   * Number of bytes following this struct.
+   */
+  size_t size;
+
+  /**
+   * Number of bytes already handed out.
+   */
+  size_t used;
+
+  /* followed by @e size bytes of memory */
+};
+
+
+/**
+ * Initialize an arena for #GNUNET_DNSPARSER_parse_arena().
+ *
+ * @param arena arena to initialize
+ * @param mem memory to carve allocations from, must remain valid
+ *        until the arena is no longer used
+ * @param mem_size number of bytes in @a mem
+ */
+void
+GNUNET_DNSPARSER_arena_init (struct GNUNET_DNSPARSER_Arena *arena,
+                             void *mem,
+                             size_t mem_size)
+{
+  arena->mem = mem;
+  arena->mem_size = mem_size;
+  arena->mem_used = 0;
+  arena->overflow = NULL;
+}
+
+
+/**
+ * Release everything that was allocated from @a arena.  Packets
+ * parsed into the arena become invalid; the arena can be reused
+ * afterwards.
+ *
+ * @param arena arena to release
+ */
+void
+GNUNET_DNSPARSER_arena_release (struct GNUNET_DNSPARSER_Arena *arena)
+{
+  struct GNUNET_DNSPARSER_ArenaChunk *chunk;
+
+  while (NULL != (chunk = arena->overflow))
+  {
+    arena->overflow = chunk->next;
+    GNUNET_free (chunk);
+  }
+  arena->mem_used = 0;
+}
+
+
+/**
+ * Carve @a size zeroed bytes out of the given memory area.
+ *
+ * @param base start of the memory area
+ * @param base_size number of bytes in @a base
+ * @param used number of bytes of @a base in use, updated
+ * @param size number of bytes to allocate
+ * @return NULL if @a size bytes do not fit
+ */
+static void *
+arena_carve (char *base,
+             size_t base_size,
+             size_t *used,
+             size_t size)
+{
+  size_t pad;
+  void *ret;
+
+  pad = (ARENA_ALIGN - ((uintptr_t) &base[*used]) % ARENA_ALIGN) % ARENA_ALIGN;
+  if ( (*used + pad > base_size) ||
+       (size > base_size - *used - pad) )
+    return NULL;
+  ret = &base[*used + pad];
+  *used += pad + size;
+  memset (ret, 0, size);
+  return ret;
+}
+
+
+/**
+ * Allocate zeroed memory for the parser, either from the heap or
+ * from an arena.
+ *
+ * @param arena arena to allocate from, NULL to use the heap
+ * @param size number of bytes to allocate
+ * @return the allocated memory
+ */
+static void *
+parse_alloc (struct GNUNET_DNSPARSER_Arena *arena,
+             size_t size)
+{
+  struct GNUNET_DNSPARSER_ArenaChunk *chunk;
+  size_t chunk_size;
+  void *ret;
+
+  if (NULL == arena)
+    return GNUNET_malloc (size);
+  if (NULL != (ret = arena_carve (arena->mem,
+                                  arena->mem_size,
+                                  &arena->mem_used,
+                                  size)))
+    return ret;
+  chunk = arena->overflow;
+  if ( (NULL != chunk) &&
+       (NULL != (ret = arena_carve ((char *) &chunk[1],
+                                    chunk->size,
+                                    &chunk->used,
+                                    size))) )
+    return ret;
+  chunk_size = GNUNET_MAX (size + ARENA_ALIGN,
+                           ARENA_CHUNK_SIZE);
+  chunk = GNUNET_malloc (sizeof (struct GNUNET_DNSPARSER_ArenaChunk) + chunk_size);
+  chunk->size = chunk_size;
+  chunk->next = arena->overflow;
+  arena->overflow = chunk;
+  ret = arena_carve ((char *) &chunk[1],
+                     chunk->size,
+                     &chunk->used,
+                     size);
+  GNUNET_assert (NULL != ret);
+  return ret;
+}
+
+
+/* ********************** DNS packet parser **************** */
+
+/**
+ * Longest name (in UTF-8) we are willing to decode.  Wire-format
+ * names are limited to 255 bytes, IDNA decoding can expand each
+ * byte to at most four.
+ */
+#define MAX_PARSED_NAME_LENGTH (4 * 256)
+
+
+/**
+ * Append a label to a name being decoded, converting it from IDNA
+ * to UTF-8 as necessary.
+ *
+ * @param name buffer with the name being decoded
+ * @param name_size number of bytes in @a name
+ * @param pos number of bytes used in @a name, updated
+ * @param label label in wire format (not 0-terminated)
+ * @param len number of bytes in @a label
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a name is full
+ */
+static int
+append_label (char *name,
+              size_t name_size,
+              size_t *pos,
+              const char *label,
+              uint8_t len)
+{
+  char tmp[GNUNET_DNSPARSER_MAX_LABEL_LENGTH + 1];
+  const char *src;
+  char *utf8;
+  size_t slen;
+  unsigned int i;
+  int ret;
+  Idna_rc rc;
+
+  /* Plain ASCII labels without the ACE prefix are left unchanged
+     by IDNA; skip the (allocating) conversion for those. */
+  for (i=0;i<len;i++)
+    if ( (0 == label[i]) ||
+         ('.' == label[i]) ||
+         (0 != (label[i] & 0x80)) )
+      break;
+  if ( (i == len) &&
+       ( (len < 4) ||
+         (0 != strncasecmp (label, "xn--", 4)) ) )
+  {
+    src = label;
+    slen = len;
+    utf8 = NULL;
+  }
+  else
+  {
+    memcpy (tmp, label, len);
+    tmp[len] = '\0';
+    if (IDNA_SUCCESS !=
+        (rc = idna_to_unicode_8z8z (tmp, &utf8, IDNA_ALLOW_UNASSIGNED)))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  _("Failed to convert DNS IDNA name `%s' to UTF-8: %s\n"),
+                  tmp,
+                  idna_strerror (rc));
+      utf8 = NULL;
+      src = tmp;
+    }
+    else
+    {
+      src = utf8;
+    }
+    slen = strlen (src);
+  }
+  if (*pos + slen + 1 >= name_size)
+  {
+    GNUNET_break_op (0);
+    ret = GNUNET_SYSERR;
+  }
+  else
+  {
+    memcpy (&name[*pos], src, slen);
+    *pos += slen;
+    name[(*pos)++] = '.';
+    ret = GNUNET_OK;
+  }
+  if (NULL != utf8)
+  {
+#if WINDOWS
+    idn_free (utf8);
+#else
+    free (utf8);
+#endif
+  }
+  return ret;
+}
+
+
+/**
+ * Parse name inside of a DNS query or record.  Labels are decoded
+ * into a buffer on the stack and compression pointers are followed
+ * iteratively, so the only allocation is the one for the result.
  *
  * @param udp_payload entire UDP payload
  * @param udp_payload_length length of @a udp_payload
  * @param off pointer to the offset of the name to parse in the udp_payload (to be
  *                    incremented by the size of the name)
- * @param depth current depth of our recursion (to prevent stack overflow)
+ * @param arena arena to allocate the result from, NULL for the heap
  * @return name as 0-terminated C string on success, NULL if the payload is malformed
  */
 static char *
 parse_name (const char *udp_payload,
 	    size_t udp_payload_length,
 	    size_t *off,
-	    unsigned int depth)
+	    struct GNUNET_DNSPARSER_Arena *arena)
 {
   const uint8_t *input = (const uint8_t *) udp_payload;
+  char name[MAX_PARSED_NAME_LENGTH];
   char *ret;
-  char *tmp;
-  char *xstr;
-  uint8_t len;
+  size_t pos;
   size_t xoff;
-  char *utf8;
-  Idna_rc rc;
+  unsigned int depth;
+  uint8_t len;
 
-  ret = GNUNET_strdup ("");
+  pos = 0;
+  depth = 0;
+  xoff = *off;
   while (1)
   {
-    if (*off >= udp_payload_length)
+    if (xoff >= udp_payload_length)
     {
       GNUNET_break_op (0);
-      goto error;
+      return NULL;
     }
-    len = input[*off];
+    len = input[xoff];
     if (0 == len)
     {
-      (*off)++;
+      xoff++;
       break;
     }
     if (len < 64)
     {
-      if (*off + 1 + len > udp_payload_length)
+      if (xoff + 1 + len > udp_payload_length)
       {
 	GNUNET_break_op (0);
-	goto error;
-      }
-      GNUNET_asprintf (&tmp,
-		       "%.*s",
-		       (int) len,
-		       &udp_payload[*off + 1]);
-      if (IDNA_SUCCESS !=
-	  (rc = idna_to_unicode_8z8z (tmp, &utf8, IDNA_ALLOW_UNASSIGNED)))
-      {
-	GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-		    _("Failed to convert DNS IDNA name `%s' to UTF-8: %s\n"),
-		    tmp,
-		    idna_strerror (rc));
-	GNUNET_free (tmp);
-	GNUNET_asprintf (&tmp,
-			 "%s%.*s.",
-			 ret,
-			 (int) len,
-			 &udp_payload[*off + 1]);
-      }
-      else
-      {
-	GNUNET_free (tmp);
-	GNUNET_asprintf (&tmp,
-			 "%s%s.",
-			 ret,
-			 utf8);
-#if WINDOWS
-	idn_free (utf8);
-#else
-	free (utf8);
-#endif
+	return NULL;
       }
-      GNUNET_free (ret);
-      ret = tmp;
-      *off += 1 + len;
+      if (GNUNET_OK !=
+          append_label (name,
+                        sizeof (name),
+                        &pos,
+                        &udp_payload[xoff + 1],
+                        len))
+        return NULL;
+      xoff += 1 + len;
     }
     else if ((64 | 128) == (len & (64 | 128)) )
     {
       if (depth > 32)
       {
 	GNUNET_break_op (0);
-	goto error; /* hard bound on stack to prevent "infinite" recursion, disallow! */
+	return NULL; /* hard bound on pointer chains to prevent "infinite" loops, disallow! */
       }
       /* pointer to string */
-      if (*off + 1 > udp_payload_length)
-      {
-	GNUNET_break_op (0);
-	goto error;
-      }
-      xoff = ((len - (64 | 128)) << 8) + input[*off+1];
-      xstr = parse_name (udp_payload,
-			 udp_payload_length,
-			 &xoff,
-			 depth + 1);
-      if (NULL == xstr)
+      if (xoff + 1 >= udp_payload_length)
       {
 	GNUNET_break_op (0);
-	goto error;
+	return NULL;
       }
-      GNUNET_asprintf (&tmp,
-		       "%s%s.",
-		       ret,
-		       xstr);
-      GNUNET_free (ret);
-      GNUNET_free (xstr);
-      ret = tmp;
-      if (strlen (ret) > udp_payload_length)
-      {
-	GNUNET_break_op (0);
-	goto error; /* we are looping (building an infinite string) */
-      }
-      *off += 2;
-      /* pointers always terminate names */
-      break;
+      /* pointers always terminate names, so the name ends here in
+         the original record */
+      if (0 == depth)
+        *off = xoff + 2;
+      depth++;
+      xoff = ((len - (64 | 128)) << 8) + input[xoff + 1];
     }
     else
     {
       /* neither pointer nor inline string, not supported... */
       GNUNET_break_op (0);
-      goto error;
+      return NULL;
     }
   }
-  if (0 < strlen(ret))
-    ret[strlen(ret)-1] = '\0'; /* eat tailing '.' */
+  if (0 == depth)
+    *off = xoff;
+  if (0 < pos)
+    pos--; /* eat tailing '.' */
+  ret = parse_alloc (arena, pos + 1);
+  memcpy (ret, name, pos);
+  ret[pos] = '\0';
   return ret;
- error:
-  GNUNET_break_op (0);
-  GNUNET_free (ret);
-  return NULL;
 }
 
 
@@ -348,7 +556,7 @@ GNUNET_DNSPARSER_parse_name (const char *udp_payload,
 			     size_t udp_payload_length,
 			     size_t *off)
 {
-  return parse_name (udp_payload, udp_payload_length, off, 0);
+  return parse_name (udp_payload, udp_payload_length, off, NULL);
 }
 
 
@@ -360,20 +568,23 @@ GNUNET_DNSPARSER_parse_name (const char *udp_payload,
  * @param off pointer to the offset of the query to parse in the udp_payload (to be
  *                    incremented by the size of the query)
  * @param q where to write the query information
+ * @param arena arena to allocate from, NULL for the heap
  * @return #GNUNET_OK on success, #GNUNET_SYSERR if the query is malformed
  */
-int
-GNUNET_DNSPARSER_parse_query (const char *udp_payload,
-			      size_t udp_payload_length,
-			      size_t *off,
-			      struct GNUNET_DNSPARSER_Query *q)
+static int
+parse_query (const char *udp_payload,
+             size_t udp_payload_length,
+             size_t *off,
+             struct GNUNET_DNSPARSER_Query *q,
+             struct GNUNET_DNSPARSER_Arena *arena)
 {
   char *name;
   struct GNUNET_TUN_DnsQueryLine ql;
 
-  name = GNUNET_DNSPARSER_parse_name (udp_payload,
-				      udp_payload_length,
-				      off);
+  name = parse_name (udp_payload,
+                     udp_payload_length,
+                     off,
+                     arena);
   if (NULL == name)
   {
     GNUNET_break_op (0);
@@ -393,6 +604,26 @@ GNUNET_DNSPARSER_parse_query (const char *udp_payload,
 }
 
 
+/**
+ * Parse a DNS query entry.
+ *
+ * @param udp_payload entire UDP payload
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the query to parse in the udp_payload (to be
+ *                    incremented by the size of the query)
+ * @param q where to write the query information
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the query is malformed
+ */
+int
+GNUNET_DNSPARSER_parse_query (const char *udp_payload,
+			      size_t udp_payload_length,
+			      size_t *off,
+			      struct GNUNET_DNSPARSER_Query *q)
+{
+  return parse_query (udp_payload, udp_payload_length, off, q, NULL);
+}
+
+
 /**
  * Parse a DNS SOA record.
  *
@@ -400,31 +631,36 @@ GNUNET_DNSPARSER_parse_query (const char *udp_payload,
  * @param udp_payload_length length of @a udp_payload
  * @param off pointer to the offset of the query to parse in the SOA record (to be
  *                    incremented by the size of the record), unchanged on error
+ * @param arena arena to allocate from, NULL for the heap
  * @return the parsed SOA record, NULL on error
  */
-struct GNUNET_DNSPARSER_SoaRecord *
-GNUNET_DNSPARSER_parse_soa (const char *udp_payload,
-			    size_t udp_payload_length,
-			    size_t *off)
+static struct GNUNET_DNSPARSER_SoaRecord *
+parse_soa (const char *udp_payload,
+           size_t udp_payload_length,
+           size_t *off,
+           struct GNUNET_DNSPARSER_Arena *arena)
 {
   struct GNUNET_DNSPARSER_SoaRecord *soa;
   struct GNUNET_TUN_DnsSoaRecord soa_bin;
   size_t old_off;
 
   old_off = *off;
-  soa = GNUNET_new (struct GNUNET_DNSPARSER_SoaRecord);
-  soa->mname = GNUNET_DNSPARSER_parse_name (udp_payload,
-					    udp_payload_length,
-					    off);
-  soa->rname = GNUNET_DNSPARSER_parse_name (udp_payload,
-					    udp_payload_length,
-					    off);
+  soa = parse_alloc (arena, sizeof (struct GNUNET_DNSPARSER_SoaRecord));
+  soa->mname = parse_name (udp_payload,
+                           udp_payload_length,
+                           off,
+                           arena);
+  soa->rname = parse_name (udp_payload,
+                           udp_payload_length,
+                           off,
+                           arena);
   if ( (NULL == soa->mname) ||
        (NULL == soa->rname) ||
        (*off + sizeof (struct GNUNET_TUN_DnsSoaRecord) > udp_payload_length) )
   {
     GNUNET_break_op (0);
-    GNUNET_DNSPARSER_free_soa (soa);
+    if (NULL == arena)
+      GNUNET_DNSPARSER_free_soa (soa);
     *off = old_off;
     return NULL;
   }
@@ -441,6 +677,24 @@ GNUNET_DNSPARSER_parse_soa (const char *udp_payload,
 }
 
 
+/**
+ * Parse a DNS SOA record.
+ *
+ * @param udp_payload reference to UDP packet
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the query to parse in the SOA record (to be
+ *                    incremented by the size of the record), unchanged on error
+ * @return the parsed SOA record, NULL on error
+ */
+struct GNUNET_DNSPARSER_SoaRecord *
+GNUNET_DNSPARSER_parse_soa (const char *udp_payload,
+			    size_t udp_payload_length,
+			    size_t *off)
+{
+  return parse_soa (udp_payload, udp_payload_length, off, NULL);
+}
+
+
 /**
  * Parse a DNS MX record.
  *
@@ -448,12 +702,14 @@ GNUNET_DNSPARSER_parse_soa (const char *udp_payload,
  * @param udp_payload_length length of @a udp_payload
  * @param off pointer to the offset of the query to parse in the MX record (to be
  *                    incremented by the size of the record), unchanged on error
+ * @param arena arena to allocate from, NULL for the heap
  * @return the parsed MX record, NULL on error
  */
-struct GNUNET_DNSPARSER_MxRecord *
-GNUNET_DNSPARSER_parse_mx (const char *udp_payload,
-			   size_t udp_payload_length,
-			   size_t *off)
+static struct GNUNET_DNSPARSER_MxRecord *
+parse_mx (const char *udp_payload,
+          size_t udp_payload_length,
+          size_t *off,
+          struct GNUNET_DNSPARSER_Arena *arena)
 {
   struct GNUNET_DNSPARSER_MxRecord *mx;
   uint16_t mxpref;
@@ -467,15 +723,17 @@ GNUNET_DNSPARSER_parse_mx (const char *udp_payload,
   }
   memcpy (&mxpref, &udp_payload[*off], sizeof (uint16_t));
   (*off) += sizeof (uint16_t);
-  mx = GNUNET_new (struct GNUNET_DNSPARSER_MxRecord);
+  mx = parse_alloc (arena, sizeof (struct GNUNET_DNSPARSER_MxRecord));
   mx->preference = ntohs (mxpref);
-  mx->mxhost = GNUNET_DNSPARSER_parse_name (udp_payload,
-					    udp_payload_length,
-					    off);
+  mx->mxhost = parse_name (udp_payload,
+                           udp_payload_length,
+                           off,
+                           arena);
   if (NULL == mx->mxhost)
   {
     GNUNET_break_op (0);
-    GNUNET_DNSPARSER_free_mx (mx);
+    if (NULL == arena)
+      GNUNET_DNSPARSER_free_mx (mx);
     *off = old_off;
     return NULL;
   }
@@ -483,6 +741,24 @@ GNUNET_DNSPARSER_parse_mx (const char *udp_payload,
 }
 
 
+/**
+ * Parse a DNS MX record.
+ *
+ * @param udp_payload reference to UDP packet
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the query to parse in the MX record (to be
+ *                    incremented by the size of the record), unchanged on error
+ * @return the parsed MX record, NULL on error
+ */
+struct GNUNET_DNSPARSER_MxRecord *
+GNUNET_DNSPARSER_parse_mx (const char *udp_payload,
+			   size_t udp_payload_length,
+			   size_t *off)
+{
+  return parse_mx (udp_payload, udp_payload_length, off, NULL);
+}
+
+
 /**
  * Parse a DNS SRV record.
  *
@@ -490,12 +766,14 @@ GNUNET_DNSPARSER_parse_mx (const char *udp_payload,
  * @param udp_payload_length length of @a udp_payload
  * @param off pointer to the offset of the query to parse in the SRV record (to be
  *                    incremented by the size of the record), unchanged on error
+ * @param arena arena to allocate from, NULL for the heap
  * @return the parsed SRV record, NULL on error
  */
-struct GNUNET_DNSPARSER_SrvRecord *
-GNUNET_DNSPARSER_parse_srv (const char *udp_payload,
-			    size_t udp_payload_length,
-			    size_t *off)
+static struct GNUNET_DNSPARSER_SrvRecord *
+parse_srv (const char *udp_payload,
+           size_t udp_payload_length,
+           size_t *off,
+           struct GNUNET_DNSPARSER_Arena *arena)
 {
   struct GNUNET_DNSPARSER_SrvRecord *srv;
   struct GNUNET_TUN_DnsSrvRecord srv_bin;
@@ -508,16 +786,18 @@ GNUNET_DNSPARSER_parse_srv (const char *udp_payload,
 	  &udp_payload[*off],
 	  sizeof (struct GNUNET_TUN_DnsSrvRecord));
   (*off) += sizeof (struct GNUNET_TUN_DnsSrvRecord);
-  srv = GNUNET_new (struct GNUNET_DNSPARSER_SrvRecord);
+  srv = parse_alloc (arena, sizeof (struct GNUNET_DNSPARSER_SrvRecord));
   srv->priority = ntohs (srv_bin.prio);
   srv->weight = ntohs (srv_bin.weight);
   srv->port = ntohs (srv_bin.port);
-  srv->target = GNUNET_DNSPARSER_parse_name (udp_payload,
-					     udp_payload_length,
-					     off);
+  srv->target = parse_name (udp_payload,
+                            udp_payload_length,
+                            off,
+                            arena);
   if (NULL == srv->target)
   {
-    GNUNET_DNSPARSER_free_srv (srv);
+    if (NULL == arena)
+      GNUNET_DNSPARSER_free_srv (srv);
     *off = old_off;
     return NULL;
   }
@@ -525,6 +805,24 @@ GNUNET_DNSPARSER_parse_srv (const char *udp_payload,
 }
 
 
+/**
+ * Parse a DNS SRV record.
+ *
+ * @param udp_payload reference to UDP packet
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the query to parse in the SRV record (to be
+ *                    incremented by the size of the record), unchanged on error
+ * @return the parsed SRV record, NULL on error
+ */
+struct GNUNET_DNSPARSER_SrvRecord *
+GNUNET_DNSPARSER_parse_srv (const char *udp_payload,
+			    size_t udp_payload_length,
+			    size_t *off)
+{
+  return parse_srv (udp_payload, udp_payload_length, off, NULL);
+}
+
+
 /**
  * Parse a DNS CERT record.
  *
@@ -532,12 +830,14 @@ GNUNET_DNSPARSER_parse_srv (const char *udp_payload,
  * @param udp_payload_length length of @a udp_payload
  * @param off pointer to the offset of the query to parse in the CERT record (to be
  *                    incremented by the size of the record), unchanged on error
+ * @param arena arena to allocate from, NULL for the heap
  * @return the parsed CERT record, NULL on error
  */
-struct GNUNET_DNSPARSER_CertRecord *
-GNUNET_DNSPARSER_parse_cert (const char *udp_payload,
-                             size_t udp_payload_length,
-                             size_t *off)
+static struct GNUNET_DNSPARSER_CertRecord *
+parse_cert (const char *udp_payload,
+            size_t udp_payload_length,
+            size_t *off,
+            struct GNUNET_DNSPARSER_Arena *arena)
 {
   struct GNUNET_DNSPARSER_CertRecord *cert;
   struct GNUNET_TUN_DnsCertRecord dcert;
@@ -549,12 +849,12 @@ GNUNET_DNSPARSER_parse_cert (const char *udp_payload,
   }
   memcpy (&dcert, &udp_payload[*off], sizeof (struct GNUNET_TUN_DnsCertRecord));
   (*off) += sizeof (struct GNUNET_TUN_DnsCertRecord);
-  cert = GNUNET_new (struct GNUNET_DNSPARSER_CertRecord);
+  cert = parse_alloc (arena, sizeof (struct GNUNET_DNSPARSER_CertRecord));
   cert->cert_type = ntohs (dcert.cert_type);
   cert->cert_tag = ntohs (dcert.cert_tag);
   cert->algorithm = dcert.algorithm;
   cert->certificate_size = udp_payload_length - (*off);
-  cert->certificate_data = GNUNET_malloc (cert->certificate_size);
+  cert->certificate_data = parse_alloc (arena, cert->certificate_size);
   memcpy (cert->certificate_data,
           &udp_payload[*off],
           cert->certificate_size);
@@ -563,6 +863,24 @@ GNUNET_DNSPARSER_parse_cert (const char *udp_payload,
 }
 
 
+/**
+ * Parse a DNS CERT record.
+ *
+ * @param udp_payload reference to UDP packet
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the query to parse in the CERT record (to be
+ *                    incremented by the size of the record), unchanged on error
+ * @return the parsed CERT record, NULL on error
+ */
+struct GNUNET_DNSPARSER_CertRecord *
+GNUNET_DNSPARSER_parse_cert (const char *udp_payload,
+                             size_t udp_payload_length,
+                             size_t *off)
+{
+  return parse_cert (udp_payload, udp_payload_length, off, NULL);
+}
+
+
 /**
  * Parse a DNS record entry.
  *
@@ -571,22 +889,25 @@ GNUNET_DNSPARSER_parse_cert (const char *udp_payload,
  * @param off pointer to the offset of the record to parse in the udp_payload (to be
  *                    incremented by the size of the record)
  * @param r where to write the record information
+ * @param arena arena to allocate from, NULL for the heap
  * @return #GNUNET_OK on success, #GNUNET_SYSERR if the record is malformed
  */
-int
-GNUNET_DNSPARSER_parse_record (const char *udp_payload,
-			       size_t udp_payload_length,
-			       size_t *off,
-			       struct GNUNET_DNSPARSER_Record *r)
+static int
+parse_record (const char *udp_payload,
+              size_t udp_payload_length,
+              size_t *off,
+              struct GNUNET_DNSPARSER_Record *r,
+              struct GNUNET_DNSPARSER_Arena *arena)
 {
   char *name;
   struct GNUNET_TUN_DnsRecordLine rl;
   size_t old_off;
   uint16_t data_len;
 
-  name = GNUNET_DNSPARSER_parse_name (udp_payload,
-				      udp_payload_length,
-				      off);
+  name = parse_name (udp_payload,
+                     udp_payload_length,
+                     off,
+                     arena);
   if (NULL == name)
   {
     GNUNET_break_op (0);
@@ -616,17 +937,19 @@ GNUNET_DNSPARSER_parse_record (const char *udp_payload,
   case GNUNET_DNSPARSER_TYPE_NS:
   case GNUNET_DNSPARSER_TYPE_CNAME:
   case GNUNET_DNSPARSER_TYPE_PTR:
-    r->data.hostname = GNUNET_DNSPARSER_parse_name (udp_payload,
-						    udp_payload_length,
-						    off);
+    r->data.hostname = parse_name (udp_payload,
+                                   udp_payload_length,
+                                   off,
+                                   arena);
     if ( (NULL == r->data.hostname) ||
 	 (old_off + data_len != *off) )
       return GNUNET_SYSERR;
     return GNUNET_OK;
   case GNUNET_DNSPARSER_TYPE_SOA:
-    r->data.soa = GNUNET_DNSPARSER_parse_soa (udp_payload,
-					      udp_payload_length,
-					      off);
+    r->data.soa = parse_soa (udp_payload,
+                             udp_payload_length,
+                             off,
+                             arena);
     if ( (NULL == r->data.soa) ||
 	 (old_off + data_len != *off) )
     {
@@ -635,9 +958,10 @@ GNUNET_DNSPARSER_parse_record (const char *udp_payload,
     }
     return GNUNET_OK;
   case GNUNET_DNSPARSER_TYPE_MX:
-    r->data.mx = GNUNET_DNSPARSER_parse_mx (udp_payload,
-					    udp_payload_length,
-					    off);
+    r->data.mx = parse_mx (udp_payload,
+                           udp_payload_length,
+                           off,
+                           arena);
     if ( (NULL == r->data.mx) ||
 	 (old_off + data_len != *off) )
     {
@@ -646,9 +970,10 @@ GNUNET_DNSPARSER_parse_record (const char *udp_payload,
     }
     return GNUNET_OK;
   case GNUNET_DNSPARSER_TYPE_SRV:
-    r->data.srv = GNUNET_DNSPARSER_parse_srv (udp_payload,
-					      udp_payload_length,
-					      off);
+    r->data.srv = parse_srv (udp_payload,
+                             udp_payload_length,
+                             off,
+                             arena);
     if ( (NULL == r->data.srv) ||
 	 (old_off + data_len != *off) )
     {
@@ -656,8 +981,21 @@ GNUNET_DNSPARSER_parse_record (const char *udp_payload,
       return GNUNET_SYSERR;
     }
     return GNUNET_OK;
+  case GNUNET_DNSPARSER_TYPE_CERT:
+    /* the certificate extends to the end of the record data */
+    r->data.cert = parse_cert (udp_payload,
+                               old_off + data_len,
+                               off,
+                               arena);
+    if ( (NULL == r->data.cert) ||
+	 (old_off + data_len != *off) )
+    {
+      GNUNET_break_op (0);
+      return GNUNET_SYSERR;
+    }
+    return GNUNET_OK;
   default:
-    r->data.raw.data = GNUNET_malloc (data_len);
+    r->data.raw.data = parse_alloc (arena, data_len);
     r->data.raw.data_len = data_len;
     memcpy (r->data.raw.data, &udp_payload[*off], data_len);
     break;
@@ -668,16 +1006,77 @@ GNUNET_DNSPARSER_parse_record (const char *udp_payload,
 
 
 /**
- * Parse a UDP payload of a DNS packet in to a nice struct for further
- * processing and manipulation.
+ * Parse a DNS record entry.
+ *
+ * @param udp_payload entire UDP payload
+ * @param udp_payload_length length of @a udp_payload
+ * @param off pointer to the offset of the record to parse in the udp_payload (to be
+ *                    incremented by the size of the record)
+ * @param r where to write the record information
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the record is malformed
+ */
+int
+GNUNET_DNSPARSER_parse_record (const char *udp_payload,
+			       size_t udp_payload_length,
+			       size_t *off,
+			       struct GNUNET_DNSPARSER_Record *r)
+{
+  return parse_record (udp_payload, udp_payload_length, off, r, NULL);
+}
+
+
+/**
+ * Parse one section of DNS records.
  *
  * @param udp_payload wire-format of the DNS packet
  * @param udp_payload_length number of bytes in @a udp_payload
+ * @param off offset of the first record, updated
+ * @param n number of records in the section
+ * @param records set to the array of parsed records
+ * @param num_records set to the number of entries in @a records
+ * @param arena arena to allocate from, NULL for the heap
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if a record is malformed
+ */
+static int
+parse_section (const char *udp_payload,
+               size_t udp_payload_length,
+               size_t *off,
+               unsigned int n,
+               struct GNUNET_DNSPARSER_Record **records,
+               unsigned int *num_records,
+               struct GNUNET_DNSPARSER_Arena *arena)
+{
+  unsigned int i;
+
+  if (0 == n)
+    return GNUNET_OK;
+  *records = parse_alloc (arena, n * sizeof (struct GNUNET_DNSPARSER_Record));
+  *num_records = n;
+  for (i=0;i<n;i++)
+    if (GNUNET_OK !=
+        parse_record (udp_payload,
+                      udp_payload_length,
+                      off,
+                      &(*records)[i],
+                      arena))
+      return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Parse a UDP payload of a DNS packet, allocating from the heap
+ * or from an arena.
+ *
+ * @param udp_payload wire-format of the DNS packet
+ * @param udp_payload_length number of bytes in @a udp_payload
+ * @param arena arena to allocate from, NULL for the heap
  * @return NULL on error, otherwise the parsed packet
  */
-struct GNUNET_DNSPARSER_Packet *
-GNUNET_DNSPARSER_parse (const char *udp_payload,
-			size_t udp_payload_length)
+static struct GNUNET_DNSPARSER_Packet *
+parse_packet (const char *udp_payload,
+              size_t udp_payload_length,
+              struct GNUNET_DNSPARSER_Arena *arena)
 {
   struct GNUNET_DNSPARSER_Packet *p;
   const struct GNUNET_TUN_DnsHeader *dns;
@@ -689,69 +1088,94 @@ GNUNET_DNSPARSER_parse (const char *udp_payload,
     return NULL;
   dns = (const struct GNUNET_TUN_DnsHeader *) udp_payload;
   off = sizeof (struct GNUNET_TUN_DnsHeader);
-  p = GNUNET_new (struct GNUNET_DNSPARSER_Packet);
+  p = parse_alloc (arena, sizeof (struct GNUNET_DNSPARSER_Packet));
   p->flags = dns->flags;
   p->id = dns->id;
   n = ntohs (dns->query_count);
   if (n > 0)
   {
-    p->queries = GNUNET_malloc (n * sizeof (struct GNUNET_DNSPARSER_Query));
+    p->queries = parse_alloc (arena, n * sizeof (struct GNUNET_DNSPARSER_Query));
     p->num_queries = n;
     for (i=0;i<n;i++)
       if (GNUNET_OK !=
-	  GNUNET_DNSPARSER_parse_query (udp_payload,
-					udp_payload_length,
-					&off,
-					&p->queries[i]))
-	goto error;
-  }
-  n = ntohs (dns->answer_rcount);
-  if (n > 0)
-  {
-    p->answers = GNUNET_malloc (n * sizeof (struct GNUNET_DNSPARSER_Record));
-    p->num_answers = n;
-    for (i=0;i<n;i++)
-      if (GNUNET_OK !=
-	  GNUNET_DNSPARSER_parse_record (udp_payload,
-					 udp_payload_length,
-					 &off,
-					 &p->answers[i]))
-	goto error;
-  }
-  n = ntohs (dns->authority_rcount);
-  if (n > 0)
-  {
-    p->authority_records = GNUNET_malloc (n * sizeof (struct GNUNET_DNSPARSER_Record));
-    p->num_authority_records = n;
-    for (i=0;i<n;i++)
-      if (GNUNET_OK !=
-	  GNUNET_DNSPARSER_parse_record (udp_payload,
-					 udp_payload_length,
-					 &off,
-					 &p->authority_records[i]))
-	goto error;
-  }
-  n = ntohs (dns->additional_rcount);
-  if (n > 0)
-  {
-    p->additional_records = GNUNET_malloc (n * sizeof (struct GNUNET_DNSPARSER_Record));
-    p->num_additional_records = n;
-    for (i=0;i<n;i++)
-      if (GNUNET_OK !=
-	  GNUNET_DNSPARSER_parse_record (udp_payload,
-					 udp_payload_length,
-					 &off,
-					 &p->additional_records[i]))
+	  parse_query (udp_payload,
+                       udp_payload_length,
+                       &off,
+                       &p->queries[i],
+                       arena))
 	goto error;
   }
+  if ( (GNUNET_OK !=
+        parse_section (udp_payload,
+                       udp_payload_length,
+                       &off,
+                       ntohs (dns->answer_rcount),
+                       &p->answers,
+                       &p->num_answers,
+                       arena)) ||
+       (GNUNET_OK !=
+        parse_section (udp_payload,
+                       udp_payload_length,
+                       &off,
+                       ntohs (dns->authority_rcount),
+                       &p->authority_records,
+                       &p->num_authority_records,
+                       arena)) ||
+       (GNUNET_OK !=
+        parse_section (udp_payload,
+                       udp_payload_length,
+                       &off,
+                       ntohs (dns->additional_rcount),
+                       &p->additional_records,
+                       &p->num_additional_records,
+                       arena)) )
+    goto error;
   return p;
  error:
   GNUNET_break_op (0);
-  GNUNET_DNSPARSER_free_packet (p);
+  if (NULL == arena)
+    GNUNET_DNSPARSER_free_packet (p);
   return NULL;
 }
 
 
+/**
+ * Parse a UDP payload of a DNS packet in to a nice struct for further
+ * processing and manipulation.
+ *
+ * @param udp_payload wire-format of the DNS packet
+ * @param udp_payload_length number of bytes in @a udp_payload
+ * @return NULL on error, otherwise the parsed packet
+ */
+struct GNUNET_DNSPARSER_Packet *
+GNUNET_DNSPARSER_parse (const char *udp_payload,
+			size_t udp_payload_length)
+{
+  return parse_packet (udp_payload, udp_payload_length, NULL);
+}
+
+
+/**
+ * Parse a UDP payload of a DNS packet, allocating the packet and
+ * everything it refers to from @a arena.  The result must not be
+ * passed to #GNUNET_DNSPARSER_free_packet() or modified with heap
+ * allocations; it is released (together with everything else in
+ * the arena) by #GNUNET_DNSPARSER_arena_release().
+ *
+ * @param arena arena to allocate from
+ * @param udp_payload wire-format of the DNS packet
+ * @param udp_payload_length number of bytes in @a udp_payload
+ * @return NULL on error, otherwise the parsed packet
+ */
+struct GNUNET_DNSPARSER_Packet *
+GNUNET_DNSPARSER_parse_arena (struct GNUNET_DNSPARSER_Arena *arena,
+                              const char *udp_payload,
+                              size_t udp_payload_length)
+{
+  return parse_packet (udp_payload, udp_payload_length, arena);
+}
+
+
 /**
  * Free memory taken by a packet.
  *
@@ -782,49 +1206,30 @@ GNUNET_DNSPARSER_free_packet (struct GNUNET_DNSPARSER_Packet *p)
 
 
 /**
- * Add a DNS name to the UDP packet at the given location, converting
- * the name to IDNA notation as necessary.
+ * Write a DNS name that is already in ASCII (IDNA) notation to the
+ * UDP packet at the given location.
  *
  * @param dst where to write the name (UDP packet)
  * @param dst_len number of bytes in @a dst
  * @param off pointer to offset where to write the name (increment by bytes used)
  *            must not be changed if there is an error
- * @param name name to write
- * @return #GNUNET_SYSERR if @a name is invalid
- *         #GNUNET_NO if @a name did not fit
- *         #GNUNET_OK if @a name was added to @a dst
+ * @param idna_name name to write
+ * @return #GNUNET_NO if @a idna_name did not fit or is malformed
+ *         #GNUNET_OK if @a idna_name was added to @a dst
  */
-int
-GNUNET_DNSPARSER_builder_add_name (char *dst,
-				   size_t dst_len,
-				   size_t *off,
-				   const char *name)
+static int
+add_ascii_name (char *dst,
+                size_t dst_len,
+                size_t *off,
+                const char *idna_name)
 {
   const char *dot;
-  const char *idna_name;
-  char *idna_start;
-  size_t start;
   size_t pos;
   size_t len;
-  Idna_rc rc;
-
-  if (NULL == name)
-    return GNUNET_SYSERR;
 
-  if (IDNA_SUCCESS !=
-      (rc = idna_to_ascii_8z (name, &idna_start, IDNA_ALLOW_UNASSIGNED)))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-		_("Failed to convert UTF-8 name `%s' to DNS IDNA format: %s\n"),
-		name,
-		idna_strerror (rc));
+  if (*off + strlen (idna_name) + 2 > dst_len)
     return GNUNET_NO;
-  }
-  idna_name = idna_start;
-  start = *off;
-  if (start + strlen (idna_name) + 2 > dst_len)
-    goto fail;
-  pos = start;
+  pos = *off;
   do
   {
     dot = strchr (idna_name, '.');
@@ -835,7 +1240,7 @@ GNUNET_DNSPARSER_builder_add_name (char *dst,
     if ( (len >= 64) || (0 == len) )
     {
       GNUNET_break (0);
-      goto fail; /* segment too long or empty */
+      return GNUNET_NO; /* segment too long or empty */
     }
     dst[pos++] = (char) (uint8_t) len;
     memcpy (&dst[pos], idna_name, len);
@@ -845,19 +1250,59 @@ GNUNET_DNSPARSER_builder_add_name (char *dst,
   while (NULL != dot);
   dst[pos++] = '\0'; /* terminator */
   *off = pos;
-#if WINDOWS
-  idn_free (idna_start);
-#else
-  free (idna_start);
-#endif
   return GNUNET_OK;
- fail:
+}
+
+
+/**
+ * Add a DNS name to the UDP packet at the given location, converting
+ * the name to IDNA notation as necessary.
+ *
+ * @param dst where to write the name (UDP packet)
+ * @param dst_len number of bytes in @a dst
+ * @param off pointer to offset where to write the name (increment by bytes used)
+ *            must not be changed if there is an error
+ * @param name name to write
+ * @return #GNUNET_SYSERR if @a name is invalid
+ *         #GNUNET_NO if @a name did not fit
+ *         #GNUNET_OK if @a name was added to @a dst
+ */
+int
+GNUNET_DNSPARSER_builder_add_name (char *dst,
+				   size_t dst_len,
+				   size_t *off,
+				   const char *name)
+{
+  char *idna_start;
+  const char *c;
+  Idna_rc rc;
+  int ret;
+
+  if (NULL == name)
+    return GNUNET_SYSERR;
+  /* IDNA leaves pure ASCII names unchanged, so write those directly
+     instead of going through an allocated conversion */
+  for (c = name; '\0' != *c; c++)
+    if (0 != (*c & 0x80))
+      break;
+  if ('\0' == *c)
+    return add_ascii_name (dst, dst_len, off, name);
+  if (IDNA_SUCCESS !=
+      (rc = idna_to_ascii_8z (name, &idna_start, IDNA_ALLOW_UNASSIGNED)))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Failed to convert UTF-8 name `%s' to DNS IDNA format: %s\n"),
+		name,
+		idna_strerror (rc));
+    return GNUNET_NO;
+  }
+  ret = add_ascii_name (dst, dst_len, off, idna_start);
 #if WINDOWS
   idn_free (idna_start);
 #else
   free (idna_start);
 #endif
-  return GNUNET_NO;
+  return ret;
 }
 
 
@@ -1128,28 +1573,61 @@ add_record (char *dst,
 
 
 /**
- * Given a DNS packet @a p, generate the corresponding UDP payload.
- * Note that we do not attempt to pack the strings with pointers
- * as this would complicate the code and this is about being
- * simple and secure, not fast, fancy and broken like bind.
+ * Add a section of DNS records to the UDP packet at the given location.
+ * Records that do not fit are dropped.
+ *
+ * @param dst where to write the records
+ * @param dst_len number of bytes in @a dst
+ * @param off pointer to offset where to write the records (increment by bytes used)
+ * @param records records to write
+ * @param num_records number of entries in @a records
+ * @return number of records written (less than @a num_records
+ *         if not all records fit), -1 if a record is invalid
+ */
+static int
+add_section (char *dst,
+             size_t dst_len,
+             size_t *off,
+             const struct GNUNET_DNSPARSER_Record *records,
+             unsigned int num_records)
+{
+  unsigned int i;
+  int ret;
+
+  for (i=0;i<num_records;i++)
+  {
+    ret = add_record (dst, dst_len, off, &records[i]);
+    if (GNUNET_SYSERR == ret)
+      return -1;
+    if (GNUNET_NO == ret)
+      break;
+  }
+  return (int) i;
+}
+
+
+/**
+ * Given a DNS packet @a p, write the corresponding UDP payload
+ * directly into @a buf, without any intermediate buffers.
  *
  * @param p packet to pack
- * @param max maximum allowed size for the resulting UDP payload
- * @param buf set to a buffer with the packed message
- * @param buf_length set to the length of @a buf
- * @return #GNUNET_SYSERR if @a p is invalid
+ * @param buf where to write the packed message; its size is the
+ *        maximum allowed size for the resulting UDP payload
+ * @param buf_size number of bytes available in @a buf
+ * @param buf_length set to the number of bytes used in @a buf
+ * @return #GNUNET_SYSERR if @a p is invalid (or @a buf cannot even
+ *           hold a DNS header)
  *         #GNUNET_NO if @a p was truncated (but there is still a result in @a buf)
  *         #GNUNET_OK if @a p was packed completely into @a buf
  */
 int
-GNUNET_DNSPARSER_pack (const struct GNUNET_DNSPARSER_Packet *p,
-		       uint16_t max,
-		       char **buf,
-		       size_t *buf_length)
+GNUNET_DNSPARSER_pack_to_buffer (const struct GNUNET_DNSPARSER_Packet *p,
+                                 char *buf,
+                                 size_t buf_size,
+                                 size_t *buf_length)
 {
   struct GNUNET_TUN_DnsHeader dns;
   size_t off;
-  char tmp[max];
   unsigned int i;
   int ret;
   int trc;
@@ -1157,79 +1635,93 @@ GNUNET_DNSPARSER_pack (const struct GNUNET_DNSPARSER_Packet *p,
   if ( (p->num_queries > UINT16_MAX) ||
        (p->num_answers > UINT16_MAX) ||
        (p->num_authority_records > UINT16_MAX) ||
-       (p->num_additional_records > UINT16_MAX) )
+       (p->num_additional_records > UINT16_MAX) ||
+       (buf_size < sizeof (struct GNUNET_TUN_DnsHeader)) )
     return GNUNET_SYSERR;
   dns.id = p->id;
   dns.flags = p->flags;
   dns.query_count = htons (p->num_queries);
-  dns.answer_rcount = htons (p->num_answers);
-  dns.authority_rcount = htons (p->num_authority_records);
-  dns.additional_rcount = htons (p->num_additional_records);
 
   off = sizeof (struct GNUNET_TUN_DnsHeader);
   trc = GNUNET_NO;
   for (i=0;i<p->num_queries;i++)
   {
-    ret = GNUNET_DNSPARSER_builder_add_query (tmp, sizeof (tmp), &off, &p->queries[i]);
-    if (GNUNET_SYSERR == ret)
-      return GNUNET_SYSERR;
-    if (GNUNET_NO == ret)
-    {
-      dns.query_count = htons ((uint16_t) (i-1));
-      trc = GNUNET_YES;
-      break;
-    }
-  }
-  for (i=0;i<p->num_answers;i++)
-  {
-    ret = add_record (tmp, sizeof (tmp), &off, &p->answers[i]);
-    if (GNUNET_SYSERR == ret)
-      return GNUNET_SYSERR;
-    if (GNUNET_NO == ret)
-    {
-      dns.answer_rcount = htons ((uint16_t) (i-1));
-      trc = GNUNET_YES;
-      break;
-    }
-  }
-  for (i=0;i<p->num_authority_records;i++)
-  {
-    ret = add_record (tmp, sizeof (tmp), &off, &p->authority_records[i]);
+    ret = GNUNET_DNSPARSER_builder_add_query (buf, buf_size, &off, &p->queries[i]);
     if (GNUNET_SYSERR == ret)
       return GNUNET_SYSERR;
     if (GNUNET_NO == ret)
     {
-      dns.authority_rcount = htons ((uint16_t) (i-1));
-      trc = GNUNET_YES;
-      break;
-    }
-  }
-  for (i=0;i<p->num_additional_records;i++)
-  {
-    ret = add_record (tmp, sizeof (tmp), &off, &p->additional_records[i]);
-    if (GNUNET_SYSERR == ret)
-      return GNUNET_SYSERR;
-    if (GNUNET_NO == ret)
-    {
-      dns.additional_rcount = htons (i-1);
+      dns.query_count = htons ((uint16_t) i);
       trc = GNUNET_YES;
       break;
     }
   }
+  ret = add_section (buf, buf_size, &off,
+                     p->answers, p->num_answers);
+  if (-1 == ret)
+    return GNUNET_SYSERR;
+  if ((unsigned int) ret != p->num_answers)
+    trc = GNUNET_YES;
+  dns.answer_rcount = htons ((uint16_t) ret);
+  ret = add_section (buf, buf_size, &off,
+                     p->authority_records, p->num_authority_records);
+  if (-1 == ret)
+    return GNUNET_SYSERR;
+  if ((unsigned int) ret != p->num_authority_records)
+    trc = GNUNET_YES;
+  dns.authority_rcount = htons ((uint16_t) ret);
+  ret = add_section (buf, buf_size, &off,
+                     p->additional_records, p->num_additional_records);
+  if (-1 == ret)
+    return GNUNET_SYSERR;
+  if ((unsigned int) ret != p->num_additional_records)
+    trc = GNUNET_YES;
+  dns.additional_rcount = htons ((uint16_t) ret);
 
   if (GNUNET_YES == trc)
     dns.flags.message_truncated = 1;
-  memcpy (tmp, &dns, sizeof (struct GNUNET_TUN_DnsHeader));
-
-  *buf = GNUNET_malloc (off);
+  memcpy (buf, &dns, sizeof (struct GNUNET_TUN_DnsHeader));
   *buf_length = off;
-  memcpy (*buf, tmp, off);
   if (GNUNET_YES == trc)
     return GNUNET_NO;
   return GNUNET_OK;
 }
 
 
+/**
+ * Given a DNS packet @a p, generate the corresponding UDP payload.
+ * Note that we do not attempt to pack the strings with pointers
+ * as this would complicate the code and this is about being
+ * simple and secure, not fast, fancy and broken like bind.
+ *
+ * @param p packet to pack
+ * @param max maximum allowed size for the resulting UDP payload
+ * @param buf set to a buffer with the packed message
+ * @param buf_length set to the length of @a buf
+ * @return #GNUNET_SYSERR if @a p is invalid
+ *         #GNUNET_NO if @a p was truncated (but there is still a result in @a buf)
+ *         #GNUNET_OK if @a p was packed completely into @a buf
+ */
+int
+GNUNET_DNSPARSER_pack (const struct GNUNET_DNSPARSER_Packet *p,
+		       uint16_t max,
+		       char **buf,
+		       size_t *buf_length)
+{
+  char tmp[max];
+  size_t off;
+  int ret;
+
+  ret = GNUNET_DNSPARSER_pack_to_buffer (p, tmp, sizeof (tmp), &off);
+  if (GNUNET_SYSERR == ret)
+    return GNUNET_SYSERR;
+  *buf = GNUNET_malloc (off);
+  *buf_length = off;
+  memcpy (*buf, tmp, off);
+  return ret;
+}
+
+
 /**
  * Convert a block of binary data to HEX.
  *
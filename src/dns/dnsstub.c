@@ -32,27 +32,236 @@
 #define REQUEST_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
 
 /**
- * How many DNS sockets do we open at most at the same time?
- * (technical socket maximum is this number x2 for IPv4+IPv6)
+ * How many UDP sockets per address family do we keep open for
+ * requests?  Each request uses one of them at random, so this
+ * determines how many different source ports we use.
  */
-#define DNS_SOCKET_MAX 128
+#define DNS_SOCKET_MAX 32
+
+/**
+ * How long do we wait for a reply before we retransmit a request
+ * (to the next DNS server) if we know nothing about the server?
+ */
+#define INITIAL_RETRY_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 500)
+
+/**
+ * Minimum time we wait before retransmitting a request.
+ */
+#define MIN_RETRY_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 100)
+
+/**
+ * Maximum time we wait before retransmitting a request.
+ */
+#define MAX_RETRY_DELAY GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * How long do we keep an idle TCP connection to a DNS server open?
+ */
+#define TCP_IDLE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10)
+
+/**
+ * How often do we try (re)connecting via TCP for a truncated reply?
+ */
+#define MAX_TCP_ATTEMPTS 2
+
+/**
+ * How many datagrams do we read at most per read event on a socket?
+ */
+#define MAX_READS_PER_EVENT 64
+
+
+struct TcpConnection;
+
+
+/**
+ * A DNS server we send requests to.
+ */
+struct DnsServer
+{
+
+  /**
+   * Address of the server.
+   */
+  struct sockaddr_storage addr;
+
+  /**
+   * Number of bytes in @e addr.
+   */
+  socklen_t addrlen;
+
+  /**
+   * Smoothed round-trip time to the server, zero if unknown.
+   */
+  struct GNUNET_TIME_Relative rtt;
+
+  /**
+   * TCP connection to the server, NULL for none.
+   */
+  struct TcpConnection *tcp;
+
+  /**
+   * #GNUNET_YES if this server was given explicitly for a single
+   * request (and thus its TCP connection cannot be reused).
+   */
+  int transient;
+
+};
+
+
+/**
+ * A UDP socket from our pool.
+ */
+struct UdpSocket
+{
+
+  /**
+   * The socket, NULL if not (yet) open.
+   */
+  struct GNUNET_NETWORK_Handle *sock;
+
+  /**
+   * Task reading from @e sock.
+   */
+  struct GNUNET_SCHEDULER_Task *read_task;
+
+  /**
+   * Context this socket belongs to.
+   */
+  struct GNUNET_DNSSTUB_Context *ctx;
+
+};
 
 
 /**
- * UDP socket we are using for sending DNS requests to the Internet.
+ * A TCP connection to a DNS server.  Several requests can be
+ * pipelined over the same connection.
+ */
+struct TcpConnection
+{
+
+  /**
+   * Kept in a DLL per context.
+   */
+  struct TcpConnection *next;
+
+  /**
+   * Kept in a DLL per context.
+   */
+  struct TcpConnection *prev;
+
+  /**
+   * Context this connection belongs to.
+   */
+  struct GNUNET_DNSSTUB_Context *ctx;
+
+  /**
+   * Server we are connected to, NULL if the connection was for
+   * a single request that is done.
+   */
+  struct DnsServer *server;
+
+  /**
+   * The socket.
+   */
+  struct GNUNET_NETWORK_Handle *sock;
+
+  /**
+   * Head of DLL of requests waiting for a reply on this connection.
+   */
+  struct GNUNET_DNSSTUB_RequestSocket *rs_head;
+
+  /**
+   * Tail of DLL of requests waiting for a reply on this connection.
+   */
+  struct GNUNET_DNSSTUB_RequestSocket *rs_tail;
+
+  /**
+   * Task reading from @e sock.
+   */
+  struct GNUNET_SCHEDULER_Task *read_task;
+
+  /**
+   * Task writing to @e sock (or waiting for the connect to finish).
+   */
+  struct GNUNET_SCHEDULER_Task *write_task;
+
+  /**
+   * Task closing the connection once it has been idle for too long.
+   */
+  struct GNUNET_SCHEDULER_Task *idle_task;
+
+  /**
+   * Data waiting to be written.
+   */
+  char *wbuf;
+
+  /**
+   * Number of bytes allocated for @e wbuf.
+   */
+  size_t wbuf_size;
+
+  /**
+   * Number of bytes in @e wbuf.
+   */
+  size_t wbuf_len;
+
+  /**
+   * Number of bytes in @e rbuf.
+   */
+  size_t rbuf_len;
+
+  /**
+   * #GNUNET_YES once the connection is established.
+   */
+  int connected;
+
+  /**
+   * Data received but not yet processed (length-prefixed replies).
+   */
+  char rbuf[sizeof (uint16_t) + UINT16_MAX];
+
+};
+
+
+/**
+ * Per-server transmission state of a request.
+ */
+struct Transmission
+{
+
+  /**
+   * When did we first send the request to the server?
+   */
+  struct GNUNET_TIME_Absolute first_sent;
+
+  /**
+   * How often did we send the request to the server?
+   */
+  unsigned int count;
+
+};
+
+
+/**
+ * Handle for a pending DNS request.
  */
 struct GNUNET_DNSSTUB_RequestSocket
 {
 
   /**
-   * UDP socket we use for this request for IPv4
+   * Kept in a DLL per TCP connection.
    */
-  struct GNUNET_NETWORK_Handle *dnsout4;
+  struct GNUNET_DNSSTUB_RequestSocket *next;
 
   /**
-   * UDP socket we use for this request for IPv6
+   * Kept in a DLL per TCP connection.
    */
-  struct GNUNET_NETWORK_Handle *dnsout6;
+  struct GNUNET_DNSSTUB_RequestSocket *prev;
+
+  /**
+   * Context this request belongs to.
+   */
+  struct GNUNET_DNSSTUB_Context *ctx;
 
   /**
    * Function to call with result.
@@ -65,183 +274,979 @@ struct GNUNET_DNSSTUB_RequestSocket
   void *rc_cls;
 
   /**
-   * Task for reading from dnsout4 and dnsout6.
+   * The request, with our (multiplexing) ID.
+   */
+  char *request;
+
+  /**
+   * Number of bytes in @e request.
+   */
+  size_t request_len;
+
+  /**
+   * Servers we may send the request to; either the servers of the
+   * context or @e own.
+   */
+  struct DnsServer *servers;
+
+  /**
+   * Transmission state per entry in @e servers.
+   */
+  struct Transmission *tx;
+
+  /**
+   * Number of entries in @e servers.
+   */
+  unsigned int num_servers;
+
+  /**
+   * Index of the server to send the next (re)transmission to.
+   */
+  unsigned int next_server;
+
+  /**
+   * How often did we try to get the reply via TCP?
+   */
+  unsigned int tcp_attempts;
+
+  /**
+   * UDP socket used for this request for IPv4, NULL if not yet used.
    */
-  struct GNUNET_SCHEDULER_Task * read_task;
+  struct UdpSocket *us4;
 
   /**
-   * When should this request time out?
+   * UDP socket used for this request for IPv6, NULL if not yet used.
+   */
+  struct UdpSocket *us6;
+
+  /**
+   * TCP connection used for this request, NULL if we use UDP.
+   */
+  struct TcpConnection *tcp;
+
+  /**
+   * Task for retransmitting the request.
+   */
+  struct GNUNET_SCHEDULER_Task *retry_task;
+
+  /**
+   * When do we stop retransmitting the request?
    */
   struct GNUNET_TIME_Absolute timeout;
 
   /**
-   * Address we sent the DNS request to.
+   * Server for requests to an explicitly given address.
+   */
+  struct DnsServer own;
+
+  /**
+   * DNS request ID as given by our client.
+   */
+  uint16_t original_id;
+
+  /**
+   * DNS request ID we use on the wire, unique among our
+   * pending requests.
    */
+  uint16_t wire_id;
+
+};
+
+
+/**
+ * Handle to the stub resolver.
+ */
+struct GNUNET_DNSSTUB_Context
+{
+
+  /**
+   * Pool of UDP sockets for IPv4.
+   */
+  struct UdpSocket sockets4[DNS_SOCKET_MAX];
+
+  /**
+   * Pool of UDP sockets for IPv6.
+   */
+  struct UdpSocket sockets6[DNS_SOCKET_MAX];
+
+  /**
+   * Head of DLL of TCP connections to DNS servers.
+   */
+  struct TcpConnection *conn_head;
+
+  /**
+   * Tail of DLL of TCP connections to DNS servers.
+   */
+  struct TcpConnection *conn_tail;
+
+  /**
+   * Pending requests, by their wire ID.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *pending;
+
+  /**
+   * DNS servers to use for #GNUNET_DNSSTUB_resolve2().
+   */
+  struct DnsServer *servers;
+
+  /**
+   * Number of entries in @e servers.
+   */
+  unsigned int num_servers;
+
+};
+
+
+/**
+ * Open source port for sending DNS requests
+ *
+ * @param af AF_INET or AF_INET6
+ * @return #GNUNET_OK on success
+ */
+static struct GNUNET_NETWORK_Handle *
+open_socket (int af)
+{
+  struct sockaddr_in a4;
+  struct sockaddr_in6 a6;
+  struct sockaddr *sa;
+  socklen_t alen;
+  struct GNUNET_NETWORK_Handle *ret;
+
+  ret = GNUNET_NETWORK_socket_create (af, SOCK_DGRAM, 0);
+  if (NULL == ret)
+    return NULL;
+  switch (af)
+  {
+  case AF_INET:
+    memset (&a4, 0, alen = sizeof (struct sockaddr_in));
+    sa = (struct sockaddr *) &a4;
+    break;
+  case AF_INET6:
+    memset (&a6, 0, alen = sizeof (struct sockaddr_in6));
+    sa = (struct sockaddr *) &a6;
+    break;
+  default:
+    GNUNET_break (0);
+    GNUNET_NETWORK_socket_close (ret);
+    return NULL;
+  }
+  sa->sa_family = af;
+  if (GNUNET_OK != GNUNET_NETWORK_socket_bind (ret,
+					       sa,
+					       alen))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Could not bind to any port: %s\n"),
+		STRERROR (errno));
+    GNUNET_NETWORK_socket_close (ret);
+    return NULL;
+  }
+  return ret;
+}
+
+
+/**
+ * Check if two socket addresses refer to the same IP and port.
+ *
+ * @param a first address
+ * @param b second address
+ * @return #GNUNET_YES if they match
+ */
+static int
+match_address (const struct sockaddr *a,
+               const struct sockaddr *b)
+{
+  if (a->sa_family != b->sa_family)
+    return GNUNET_NO;
+  switch (a->sa_family)
+  {
+  case AF_INET:
+    {
+      const struct sockaddr_in *a4 = (const struct sockaddr_in *) a;
+      const struct sockaddr_in *b4 = (const struct sockaddr_in *) b;
+
+      return ( (a4->sin_port == b4->sin_port) &&
+               (a4->sin_addr.s_addr == b4->sin_addr.s_addr) )
+        ? GNUNET_YES : GNUNET_NO;
+    }
+  case AF_INET6:
+    {
+      const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *) a;
+      const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *) b;
+
+      return ( (a6->sin6_port == b6->sin6_port) &&
+               (0 == memcmp (&a6->sin6_addr,
+                             &b6->sin6_addr,
+                             sizeof (struct in6_addr))) )
+        ? GNUNET_YES : GNUNET_NO;
+    }
+  default:
+    return GNUNET_NO;
+  }
+}
+
+
+/**
+ * Close a TCP connection.  Requests still using it must have been
+ * detached already.
+ *
+ * @param conn connection to close
+ */
+static void
+destroy_tcp_connection (struct TcpConnection *conn)
+{
+  GNUNET_assert (NULL == conn->rs_head);
+  if ( (NULL != conn->server) &&
+       (conn->server->tcp == conn) )
+    conn->server->tcp = NULL;
+  GNUNET_CONTAINER_DLL_remove (conn->ctx->conn_head,
+                               conn->ctx->conn_tail,
+                               conn);
+  if (NULL != conn->read_task)
+    GNUNET_SCHEDULER_cancel (conn->read_task);
+  if (NULL != conn->write_task)
+    GNUNET_SCHEDULER_cancel (conn->write_task);
+  if (NULL != conn->idle_task)
+    GNUNET_SCHEDULER_cancel (conn->idle_task);
+  GNUNET_NETWORK_socket_close (conn->sock);
+  GNUNET_free_non_null (conn->wbuf);
+  GNUNET_free (conn);
+}
+
+
+/**
+ * A TCP connection has been idle for too long, close it.
+ *
+ * @param cls the `struct TcpConnection`
+ * @param tc scheduler context
+ */
+static void
+tcp_idle_timeout (void *cls,
+                  const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct TcpConnection *conn = cls;
+
+  conn->idle_task = NULL;
+  destroy_tcp_connection (conn);
+}
+
+
+/**
+ * Stop all activity for a request and remove it from the
+ * context, but do not free the handle itself.
+ *
+ * @param rs request to release
+ */
+static void
+release_request (struct GNUNET_DNSSTUB_RequestSocket *rs)
+{
+  struct TcpConnection *conn;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap32_remove (rs->ctx->pending,
+                                                         rs->wire_id,
+                                                         rs));
+  if (NULL != rs->retry_task)
+  {
+    GNUNET_SCHEDULER_cancel (rs->retry_task);
+    rs->retry_task = NULL;
+  }
+  if (NULL != (conn = rs->tcp))
+  {
+    GNUNET_CONTAINER_DLL_remove (conn->rs_head,
+                                 conn->rs_tail,
+                                 rs);
+    rs->tcp = NULL;
+    if (NULL == conn->rs_head)
+    {
+      /* never close the connection right away, we may be
+         processing a reply received on it */
+      if (GNUNET_YES == conn->server->transient)
+      {
+        /* nobody else can use it, and the server is part of @a rs */
+        conn->server->tcp = NULL;
+        conn->server = NULL;
+        conn->idle_task = GNUNET_SCHEDULER_add_now (&tcp_idle_timeout,
+                                                    conn);
+      }
+      else
+      {
+        conn->idle_task = GNUNET_SCHEDULER_add_delayed (TCP_IDLE_TIMEOUT,
+                                                        &tcp_idle_timeout,
+                                                        conn);
+      }
+    }
+  }
+  GNUNET_free (rs->request);
+  rs->request = NULL;
+  GNUNET_free (rs->tx);
+  rs->tx = NULL;
+}
+
+
+/**
+ * Pass a reply to the client of a request and free the request.
+ *
+ * @param rs request the reply is for
+ * @param dns the reply (with our wire ID), will be modified
+ * @param dns_len number of bytes in @a dns
+ */
+static void
+deliver_reply (struct GNUNET_DNSSTUB_RequestSocket *rs,
+               struct GNUNET_TUN_DnsHeader *dns,
+               size_t dns_len)
+{
+  release_request (rs);
+  dns->id = rs->original_id;
+  if (NULL != rs->rc)
+    rs->rc (rs->rc_cls,
+            rs,
+            dns,
+            dns_len);
+  GNUNET_free (rs);
+}
+
+
+/**
+ * Read a DNS response from one of our UDP sockets.
+ *
+ * @param cls the `struct UdpSocket` to read from
+ * @param tc scheduler context (must be shutdown or read ready)
+ */
+static void
+read_response (void *cls,
+	       const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Get a socket of the specified address family to send out a
+ * UDP DNS request to the Internet.  Sockets are opened on demand
+ * and kept open until the context is stopped.
+ *
+ * @param ctx the DNSSTUB context
+ * @param af desired address family
+ * @return NULL on error (given AF not "supported")
+ */
+static struct UdpSocket *
+get_request_socket (struct GNUNET_DNSSTUB_Context *ctx,
+		    int af)
+{
+  struct UdpSocket *us;
+  uint32_t off;
+
+  off = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                  DNS_SOCKET_MAX);
+  switch (af)
+  {
+  case AF_INET:
+    us = &ctx->sockets4[off];
+    break;
+  case AF_INET6:
+    us = &ctx->sockets6[off];
+    break;
+  default:
+    return NULL;
+  }
+  if (NULL != us->sock)
+    return us;
+  if (NULL == (us->sock = open_socket (af)))
+    return NULL;
+  us->ctx = ctx;
+  us->read_task = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 us->sock,
+                                                 &read_response,
+                                                 us);
+  return us;
+}
+
+
+/**
+ * How long should we wait for a reply from @a server before
+ * retransmitting?
+ *
+ * @param server server we sent the request to
+ * @return retransmission delay
+ */
+static struct GNUNET_TIME_Relative
+get_retry_delay (const struct DnsServer *server)
+{
+  struct GNUNET_TIME_Relative delay;
+
+  if (0 == server->rtt.rel_value_us)
+    return INITIAL_RETRY_DELAY;
+  delay = GNUNET_TIME_relative_multiply (server->rtt, 3);
+  delay = GNUNET_TIME_relative_max (delay, MIN_RETRY_DELAY);
+  return GNUNET_TIME_relative_min (delay, MAX_RETRY_DELAY);
+}
+
+
+/**
+ * Task that (re)transmits a request via UDP to the next server.
+ *
+ * @param cls the `struct GNUNET_DNSSTUB_RequestSocket`
+ * @param tc scheduler context
+ */
+static void
+transmit_udp (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_DNSSTUB_RequestSocket *rs = cls;
+  struct DnsServer *server;
+  struct Transmission *tx;
+  struct UdpSocket **us;
+  struct GNUNET_TIME_Relative left;
+  struct GNUNET_TIME_Relative delay;
+
+  rs->retry_task = NULL;
+  left = GNUNET_TIME_absolute_get_remaining (rs->timeout);
+  if (0 == left.rel_value_us)
+    return; /* give up, wait for a late reply or cancellation */
+  server = &rs->servers[rs->next_server];
+  tx = &rs->tx[rs->next_server];
+  rs->next_server = (rs->next_server + 1) % rs->num_servers;
+  us = (AF_INET == server->addr.ss_family) ? &rs->us4 : &rs->us6;
+  if (NULL == *us)
+    *us = get_request_socket (rs->ctx,
+                              server->addr.ss_family);
+  if (NULL == *us)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Failed to send DNS request to %s\n"),
+		GNUNET_a2s ((const struct sockaddr *) &server->addr,
+                            server->addrlen));
+  else if (GNUNET_SYSERR ==
+      GNUNET_NETWORK_socket_sendto ((*us)->sock,
+				    rs->request,
+				    rs->request_len,
+				    (const struct sockaddr *) &server->addr,
+				    server->addrlen))
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+		_("Failed to send DNS request to %s\n"),
+		GNUNET_a2s ((const struct sockaddr *) &server->addr,
+                            server->addrlen));
+  else
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Sent DNS request to %s\n",
+		GNUNET_a2s ((const struct sockaddr *) &server->addr,
+                            server->addrlen));
+  if (0 == tx->count)
+    tx->first_sent = GNUNET_TIME_absolute_get ();
+  tx->count++;
+  /* back off exponentially if the servers do not answer */
+  delay = GNUNET_TIME_relative_multiply (get_retry_delay (server),
+                                         1 << GNUNET_MIN (tx->count - 1, 3));
+  rs->retry_task
+    = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_min (delay,
+                                                              left),
+                                    &transmit_udp,
+                                    rs);
+}
+
+
+/**
+ * Get a TCP connection to the given server, reusing an existing
+ * one if possible.
+ *
+ * @param ctx the DNSSTUB context
+ * @param server server to connect to
+ * @return NULL on error
+ */
+static struct TcpConnection *
+get_tcp_connection (struct GNUNET_DNSSTUB_Context *ctx,
+                    struct DnsServer *server);
+
+
+/**
+ * Send a request via TCP to the given server.  Used if a UDP reply
+ * was truncated.
+ *
+ * @param rs request to send
+ * @param server server to send it to
+ */
+static void
+transmit_tcp (struct GNUNET_DNSSTUB_RequestSocket *rs,
+              struct DnsServer *server);
+
+
+/**
+ * Process a DNS reply received via UDP.
+ *
+ * @param us socket the reply was received on
+ * @param addr sender of the reply
+ * @param buf the reply
+ * @param r number of bytes in @a buf
+ */
+static void
+handle_udp_reply (struct UdpSocket *us,
+                  const struct sockaddr *addr,
+                  char *buf,
+                  size_t r)
+{
+  struct GNUNET_DNSSTUB_RequestSocket *rs;
+  struct GNUNET_TUN_DnsHeader *dns;
+  struct GNUNET_TIME_Relative rtt;
+  unsigned int i;
+
+  if (sizeof (struct GNUNET_TUN_DnsHeader) > r)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Received DNS response that is too small (%u bytes)"),
+                (unsigned int) r);
+    return;
+  }
+  dns = (struct GNUNET_TUN_DnsHeader *) buf;
+  rs = GNUNET_CONTAINER_multihashmap32_get (us->ctx->pending,
+                                            dns->id);
+  if ( (NULL == rs) ||
+       ( (rs->us4 != us) &&
+         (rs->us6 != us) ) ||
+       (NULL != rs->tcp) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Received DNS reply that does not match any pending request; ignoring reply\n");
+    return;
+  }
+  for (i=0;i<rs->num_servers;i++)
+    if ( (0 != rs->tx[i].count) &&
+         (GNUNET_YES == match_address ((const struct sockaddr *) &rs->servers[i].addr,
+                                       addr)) )
+      break;
+  if (i == rs->num_servers)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Invalid sender address; ignoring reply\n");
+    return;
+  }
+  if (1 == rs->tx[i].count)
+  {
+    /* only sample the RTT if the reply cannot be for a retransmission */
+    rtt = GNUNET_TIME_absolute_get_duration (rs->tx[i].first_sent);
+    if (0 == rs->servers[i].rtt.rel_value_us)
+      rs->servers[i].rtt = rtt;
+    else
+      rs->servers[i].rtt.rel_value_us
+        = (7 * rs->servers[i].rtt.rel_value_us + rtt.rel_value_us) / 8;
+  }
+  if ( (1 == dns->flags.message_truncated) &&
+       (rs->tcp_attempts < MAX_TCP_ATTEMPTS) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "DNS reply truncated, retrying via TCP\n");
+    transmit_tcp (rs, &rs->servers[i]);
+    return;
+  }
+  deliver_reply (rs, dns, r);
+}
+
+
+/**
+ * Read DNS responses from one of our UDP sockets.
+ *
+ * @param cls the `struct UdpSocket` to read from
+ * @param tc scheduler context (must be shutdown or read ready)
+ */
+static void
+read_response (void *cls,
+	       const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct UdpSocket *us = cls;
   struct sockaddr_storage addr;
-
-  /**
-   * Number of bytes in @e addr.
-   */
   socklen_t addrlen;
+  char buf[UINT16_MAX] GNUNET_ALIGN;
+  ssize_t r;
+  unsigned int i;
 
-};
+  us->read_task = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 us->sock,
+                                                 &read_response,
+                                                 us);
+  if (0 == (tc->reason & GNUNET_SCHEDULER_REASON_READ_READY))
+    return; /* shutdown */
+  for (i=0;i<MAX_READS_PER_EVENT;i++)
+  {
+    addrlen = sizeof (addr);
+    memset (&addr, 0, sizeof (addr));
+    r = GNUNET_NETWORK_socket_recvfrom (us->sock,
+                                        buf, sizeof (buf),
+                                        (struct sockaddr*) &addr, &addrlen);
+    if (-1 == r)
+    {
+      if ( (EAGAIN != errno) &&
+           (EWOULDBLOCK != errno) )
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "recvfrom");
+      return;
+    }
+    handle_udp_reply (us,
+                      (const struct sockaddr *) &addr,
+                      buf,
+                      r);
+  }
+}
 
 
 /**
- * Handle to the stub resolver.
+ * A TCP connection failed.  Close it and retry the requests that
+ * were using it on a fresh connection (if they have attempts left).
+ *
+ * @param conn the connection that failed
  */
-struct GNUNET_DNSSTUB_Context
+static void
+tcp_failed (struct TcpConnection *conn)
 {
+  struct GNUNET_DNSSTUB_RequestSocket *head;
+  struct GNUNET_DNSSTUB_RequestSocket *rs;
+  struct DnsServer *server = conn->server;
 
-  /**
-   * Array of all open sockets for DNS requests.
-   */
-  struct GNUNET_DNSSTUB_RequestSocket sockets[DNS_SOCKET_MAX];
+  if (NULL != server)
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "TCP connection to DNS server %s failed\n",
+                GNUNET_a2s ((const struct sockaddr *) &server->addr,
+                            server->addrlen));
+  head = conn->rs_head;
+  conn->rs_head = NULL;
+  conn->rs_tail = NULL;
+  destroy_tcp_connection (conn);
+  while (NULL != (rs = head))
+  {
+    head = rs->next;
+    rs->next = NULL;
+    rs->prev = NULL;
+    rs->tcp = NULL;
+    if (rs->tcp_attempts < MAX_TCP_ATTEMPTS)
+      transmit_tcp (rs, server);
+  }
+}
 
-  /**
-   * IP address to use for the DNS server if we are a DNS exit service
-   * (for VPN via cadet); otherwise NULL.
-   */
-  char *dns_exit;
-};
 
+/**
+ * Task to write queued requests to a TCP connection (or to
+ * finish connecting).
+ *
+ * @param cls the `struct TcpConnection`
+ * @param tc scheduler context
+ */
+static void
+tcp_write (void *cls,
+           const struct GNUNET_SCHEDULER_TaskContext *tc);
 
 
 /**
- * We're done with a `struct GNUNET_DNSSTUB_RequestSocket`, close it for now.
+ * Task to read replies from a TCP connection.
  *
- * @param rs request socket to clean up
+ * @param cls the `struct TcpConnection`
+ * @param tc scheduler context
  */
 static void
-cleanup_rs (struct GNUNET_DNSSTUB_RequestSocket *rs)
+tcp_read (void *cls,
+          const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  if (NULL != rs->dnsout4)
+  struct TcpConnection *conn = cls;
+  struct GNUNET_DNSSTUB_RequestSocket *rs;
+  struct GNUNET_TUN_DnsHeader *dns;
+  ssize_t r;
+  uint16_t len;
+
+  conn->read_task = NULL;
+  if (0 == (tc->reason & GNUNET_SCHEDULER_REASON_READ_READY))
+    return; /* shutdown */
+  r = GNUNET_NETWORK_socket_recv (conn->sock,
+                                  &conn->rbuf[conn->rbuf_len],
+                                  sizeof (conn->rbuf) - conn->rbuf_len);
+  if ( (-1 == r) &&
+       ( (EAGAIN == errno) ||
+         (EWOULDBLOCK == errno) ) )
   {
-    GNUNET_NETWORK_socket_close (rs->dnsout4);
-    rs->dnsout4 = NULL;
+    conn->read_task = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                     conn->sock,
+                                                     &tcp_read,
+                                                     conn);
+    return;
   }
-  if (NULL != rs->dnsout6)
+  if (0 >= r)
   {
-    GNUNET_NETWORK_socket_close (rs->dnsout6);
-    rs->dnsout6 = NULL;
+    tcp_failed (conn);
+    return;
   }
-  if (NULL != rs->read_task)
+  conn->rbuf_len += r;
+  conn->read_task = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                   conn->sock,
+                                                   &tcp_read,
+                                                   conn);
+  /* process all complete replies */
+  while (conn->rbuf_len >= sizeof (uint16_t))
   {
-    GNUNET_SCHEDULER_cancel (rs->read_task);
-    rs->read_task = NULL;
+    memcpy (&len, conn->rbuf, sizeof (uint16_t));
+    len = ntohs (len);
+    if (conn->rbuf_len < sizeof (uint16_t) + len)
+      break;
+    dns = (struct GNUNET_TUN_DnsHeader *) &conn->rbuf[sizeof (uint16_t)];
+    if (len >= sizeof (struct GNUNET_TUN_DnsHeader))
+    {
+      rs = GNUNET_CONTAINER_multihashmap32_get (conn->ctx->pending,
+                                                dns->id);
+      if ( (NULL != rs) &&
+           (rs->tcp == conn) )
+        deliver_reply (rs, dns, len);
+    }
+    conn->rbuf_len -= sizeof (uint16_t) + len;
+    memmove (conn->rbuf,
+             &conn->rbuf[sizeof (uint16_t) + len],
+             conn->rbuf_len);
   }
 }
 
 
 /**
- * Open source port for sending DNS requests
+ * Task to write queued requests to a TCP connection (or to
+ * finish connecting).
  *
- * @param af AF_INET or AF_INET6
- * @return #GNUNET_OK on success
+ * @param cls the `struct TcpConnection`
+ * @param tc scheduler context
  */
-static struct GNUNET_NETWORK_Handle *
-open_socket (int af)
+static void
+tcp_write (void *cls,
+           const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct sockaddr_in a4;
-  struct sockaddr_in6 a6;
-  struct sockaddr *sa;
-  socklen_t alen;
-  struct GNUNET_NETWORK_Handle *ret;
+  struct TcpConnection *conn = cls;
+  ssize_t r;
+  int error;
+  socklen_t len;
 
-  ret = GNUNET_NETWORK_socket_create (af, SOCK_DGRAM, 0);
-  if (NULL == ret)
-    return NULL;
-  switch (af)
+  conn->write_task = NULL;
+  if (0 == (tc->reason & GNUNET_SCHEDULER_REASON_WRITE_READY))
   {
-  case AF_INET:
-    memset (&a4, 0, alen = sizeof (struct sockaddr_in));
-    sa = (struct sockaddr *) &a4;
-    break;
-  case AF_INET6:
-    memset (&a6, 0, alen = sizeof (struct sockaddr_in6));
-    sa = (struct sockaddr *) &a6;
-    break;
-  default:
-    GNUNET_break (0);
-    GNUNET_NETWORK_socket_close (ret);
-    return NULL;
+    if (GNUNET_YES != conn->connected)
+      tcp_failed (conn); /* connect timed out */
+    return;
   }
-  sa->sa_family = af;
-  if (GNUNET_OK != GNUNET_NETWORK_socket_bind (ret,
-					       sa,
-					       alen))
+  if (GNUNET_YES != conn->connected)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		_("Could not bind to any port: %s\n"),
-		STRERROR (errno));
-    GNUNET_NETWORK_socket_close (ret);
+    error = 0;
+    len = sizeof (error);
+    if ( (GNUNET_OK !=
+          GNUNET_NETWORK_socket_getsockopt (conn->sock,
+                                            SOL_SOCKET,
+                                            SO_ERROR,
+                                            &error,
+                                            &len)) ||
+         (0 != error) )
+    {
+      tcp_failed (conn);
+      return;
+    }
+    conn->connected = GNUNET_YES;
+    conn->read_task = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                     conn->sock,
+                                                     &tcp_read,
+                                                     conn);
+  }
+  if (0 == conn->wbuf_len)
+    return;
+  r = GNUNET_NETWORK_socket_send (conn->sock,
+                                  conn->wbuf,
+                                  conn->wbuf_len);
+  if (-1 == r)
+  {
+    if ( (EAGAIN != errno) &&
+         (EWOULDBLOCK != errno) )
+    {
+      tcp_failed (conn);
+      return;
+    }
+    r = 0;
+  }
+  conn->wbuf_len -= r;
+  memmove (conn->wbuf,
+           &conn->wbuf[r],
+           conn->wbuf_len);
+  if (0 != conn->wbuf_len)
+    conn->write_task = GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                       conn->sock,
+                                                       &tcp_write,
+                                                       conn);
+}
+
+
+/**
+ * Get a TCP connection to the given server, reusing an existing
+ * one if possible.
+ *
+ * @param ctx the DNSSTUB context
+ * @param server server to connect to
+ * @return NULL on error
+ */
+static struct TcpConnection *
+get_tcp_connection (struct GNUNET_DNSSTUB_Context *ctx,
+                    struct DnsServer *server)
+{
+  struct TcpConnection *conn;
+  struct GNUNET_NETWORK_Handle *sock;
+
+  if (NULL != (conn = server->tcp))
+  {
+    if (NULL != conn->idle_task)
+    {
+      GNUNET_SCHEDULER_cancel (conn->idle_task);
+      conn->idle_task = NULL;
+    }
+    return conn;
+  }
+  sock = GNUNET_NETWORK_socket_create (server->addr.ss_family,
+                                       SOCK_STREAM,
+                                       0);
+  if (NULL == sock)
+    return NULL;
+  if ( (GNUNET_OK !=
+        GNUNET_NETWORK_socket_connect (sock,
+                                       (const struct sockaddr *) &server->addr,
+                                       server->addrlen)) &&
+       (EINPROGRESS != errno) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "connect");
+    GNUNET_NETWORK_socket_close (sock);
     return NULL;
   }
-  return ret;
+  conn = GNUNET_new (struct TcpConnection);
+  GNUNET_CONTAINER_DLL_insert (ctx->conn_head,
+                               ctx->conn_tail,
+                               conn);
+  conn->ctx = ctx;
+  conn->server = server;
+  conn->sock = sock;
+  conn->write_task = GNUNET_SCHEDULER_add_write_net (REQUEST_TIMEOUT,
+                                                     sock,
+                                                     &tcp_write,
+                                                     conn);
+  server->tcp = conn;
+  return conn;
 }
 
 
 /**
- * Read a DNS response from the (unhindered) UDP-Socket
+ * Send a request via TCP to the given server.  Used if a UDP reply
+ * was truncated.
  *
- * @param cls socket to read from
- * @param tc scheduler context (must be shutdown or read ready)
+ * @param rs request to send
+ * @param server server to send it to
  */
 static void
-read_response (void *cls,
-	       const struct GNUNET_SCHEDULER_TaskContext *tc);
+transmit_tcp (struct GNUNET_DNSSTUB_RequestSocket *rs,
+              struct DnsServer *server)
+{
+  struct TcpConnection *conn;
+  uint16_t len;
+
+  if (NULL != rs->retry_task)
+  {
+    GNUNET_SCHEDULER_cancel (rs->retry_task);
+    rs->retry_task = NULL;
+  }
+  rs->tcp_attempts++;
+  rs->timeout = GNUNET_TIME_relative_to_absolute (REQUEST_TIMEOUT);
+  if (NULL == (conn = get_tcp_connection (rs->ctx, server)))
+    return; /* wait for cancellation */
+  rs->tcp = conn;
+  GNUNET_CONTAINER_DLL_insert_tail (conn->rs_head,
+                                    conn->rs_tail,
+                                    rs);
+  if (conn->wbuf_size < conn->wbuf_len + sizeof (uint16_t) + rs->request_len)
+  {
+    conn->wbuf_size = conn->wbuf_len + sizeof (uint16_t) + rs->request_len;
+    conn->wbuf = GNUNET_realloc (conn->wbuf,
+                                 conn->wbuf_size);
+  }
+  len = htons ((uint16_t) rs->request_len);
+  memcpy (&conn->wbuf[conn->wbuf_len],
+          &len,
+          sizeof (uint16_t));
+  memcpy (&conn->wbuf[conn->wbuf_len + sizeof (uint16_t)],
+          rs->request,
+          rs->request_len);
+  conn->wbuf_len += sizeof (uint16_t) + rs->request_len;
+  if ( (GNUNET_YES == conn->connected) &&
+       (NULL == conn->write_task) )
+    conn->write_task = GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                       conn->sock,
+                                                       &tcp_write,
+                                                       conn);
+}
 
 
 /**
- * Get a socket of the specified address family to send out a
- * UDP DNS request to the Internet.
+ * Create a request and send it to the first server.
  *
- * @param ctx the DNSSTUB context
- * @param af desired address family
- * @return NULL on error (given AF not "supported")
+ * @param ctx stub resolver to use
+ * @param rs request handle, with @e servers and @e num_servers set
+ * @param request DNS request to transmit
+ * @param request_len number of bytes in msg
+ * @param rc function to call with result
+ * @param rc_cls closure for 'rc'
+ * @return @a rs, NULL on error (then @a rs was freed)
  */
 static struct GNUNET_DNSSTUB_RequestSocket *
-get_request_socket (struct GNUNET_DNSSTUB_Context *ctx,
-		    int af)
+start_request (struct GNUNET_DNSSTUB_Context *ctx,
+               struct GNUNET_DNSSTUB_RequestSocket *rs,
+               const void *request,
+               size_t request_len,
+               GNUNET_DNSSTUB_ResultCallback rc,
+               void *rc_cls)
 {
-  struct GNUNET_DNSSTUB_RequestSocket *rs;
-  struct GNUNET_NETWORK_FDSet *rset;
+  struct GNUNET_TUN_DnsHeader *dns;
+  struct GNUNET_TIME_Relative best;
+  struct GNUNET_TIME_Relative delay;
+  unsigned int i;
 
-  rs = &ctx->sockets[GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
-					       DNS_SOCKET_MAX)];
-  rs->timeout = GNUNET_TIME_relative_to_absolute (REQUEST_TIMEOUT);
-  switch (af)
+  if ( (request_len < sizeof (struct GNUNET_TUN_DnsHeader)) ||
+       (request_len > UINT16_MAX) ||
+       (GNUNET_CONTAINER_multihashmap32_size (ctx->pending) >= UINT16_MAX) )
   {
-  case AF_INET:
-    if (NULL == rs->dnsout4)
-      rs->dnsout4 = open_socket (AF_INET);
-    break;
-  case AF_INET6:
-    if (NULL == rs->dnsout6)
-      rs->dnsout6 = open_socket (AF_INET6);
-    break;
-  default:
+    GNUNET_break (0);
+    GNUNET_free (rs);
     return NULL;
   }
-  if (NULL != rs->read_task)
+  /* start with the server that answered fastest so far */
+  best = GNUNET_TIME_UNIT_FOREVER_REL;
+  for (i=0;i<rs->num_servers;i++)
   {
-    GNUNET_SCHEDULER_cancel (rs->read_task);
-    rs->read_task = NULL;
+    delay = get_retry_delay (&rs->servers[i]);
+    if (delay.rel_value_us < best.rel_value_us)
+    {
+      best = delay;
+      rs->next_server = i;
+    }
   }
-  if ( (NULL == rs->dnsout4) &&
-       (NULL == rs->dnsout6) )
+  if (AF_INET == rs->servers[rs->next_server].addr.ss_family)
+    rs->us4 = get_request_socket (ctx, AF_INET);
+  else
+    rs->us6 = get_request_socket (ctx, AF_INET6);
+  if ( (NULL == rs->us4) &&
+       (NULL == rs->us6) )
+  {
+    GNUNET_free (rs);
     return NULL;
-  rset = GNUNET_NETWORK_fdset_create ();
-  if (NULL != rs->dnsout4)
-    GNUNET_NETWORK_fdset_set (rset, rs->dnsout4);
-  if (NULL != rs->dnsout6)
-    GNUNET_NETWORK_fdset_set (rset, rs->dnsout6);
-  rs->read_task = GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
-					       REQUEST_TIMEOUT,
-					       rset,
-					       NULL,
-					       &read_response, rs);
-  GNUNET_NETWORK_fdset_destroy (rset);
+  }
+  rs->ctx = ctx;
+  rs->rc = rc;
+  rs->rc_cls = rc_cls;
+  rs->request = GNUNET_malloc (request_len);
+  memcpy (rs->request, request, request_len);
+  rs->request_len = request_len;
+  rs->tx = GNUNET_malloc (rs->num_servers * sizeof (struct Transmission));
+  rs->timeout = GNUNET_TIME_relative_to_absolute (REQUEST_TIMEOUT);
+  dns = (struct GNUNET_TUN_DnsHeader *) rs->request;
+  rs->original_id = dns->id;
+  do
+    rs->wire_id = (uint16_t) GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
+                                                       UINT16_MAX + 1);
+  while (GNUNET_YES ==
+         GNUNET_CONTAINER_multihashmap32_contains (ctx->pending,
+                                                   rs->wire_id));
+  dns->id = rs->wire_id;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (ctx->pending,
+                                                      rs->wire_id,
+                                                      rs,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  transmit_udp (rs, NULL);
   return rs;
 }
 
@@ -268,37 +1273,26 @@ GNUNET_DNSSTUB_resolve (struct GNUNET_DNSSTUB_Context *ctx,
 			void *rc_cls)
 {
   struct GNUNET_DNSSTUB_RequestSocket *rs;
-  struct GNUNET_NETWORK_Handle *ret;
-  int af;
 
-  af = sa->sa_family;
-  if (NULL == (rs = get_request_socket (ctx, af)))
+  if (sa_len > sizeof (struct sockaddr_storage))
+  {
+    GNUNET_break (0);
     return NULL;
-  if (NULL != rs->dnsout4)
-    ret = rs->dnsout4;
-  else
-    ret = rs->dnsout6;
-  GNUNET_assert (NULL != ret);
-  memcpy (&rs->addr,
+  }
+  rs = GNUNET_new (struct GNUNET_DNSSTUB_RequestSocket);
+  memcpy (&rs->own.addr,
 	  sa,
 	  sa_len);
-  rs->addrlen = sa_len;
-  rs->rc = rc;
-  rs->rc_cls = rc_cls;
-  if (GNUNET_SYSERR ==
-      GNUNET_NETWORK_socket_sendto (ret,
-				    request,
-				    request_len,
-				    sa,
-				    sa_len))
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-		_("Failed to send DNS request to %s\n"),
-		GNUNET_a2s (sa, sa_len));
-  else
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		_("Sent DNS request to %s\n"),
-		GNUNET_a2s (sa, sa_len));
-  return rs;
+  rs->own.addrlen = sa_len;
+  rs->own.transient = GNUNET_YES;
+  rs->servers = &rs->own;
+  rs->num_servers = 1;
+  return start_request (ctx,
+                        rs,
+                        request,
+                        request_len,
+                        rc,
+                        rc_cls);
 }
 
 
@@ -319,226 +1313,161 @@ GNUNET_DNSSTUB_resolve2 (struct GNUNET_DNSSTUB_Context *ctx,
 			 GNUNET_DNSSTUB_ResultCallback rc,
 			 void *rc_cls)
 {
-  int af;
-  struct sockaddr_in v4;
-  struct sockaddr_in6 v6;
-  struct sockaddr *sa;
-  socklen_t salen;
-  struct GNUNET_NETWORK_Handle *dnsout;
   struct GNUNET_DNSSTUB_RequestSocket *rs;
 
-  memset (&v4, 0, sizeof (v4));
-  memset (&v6, 0, sizeof (v6));
-  if (1 == inet_pton (AF_INET, ctx->dns_exit, &v4.sin_addr))
-  {
-    salen = sizeof (v4);
-    v4.sin_family = AF_INET;
-    v4.sin_port = htons (53);
-#if HAVE_SOCKADDR_IN_SIN_LEN
-    v4.sin_len = (u_char) salen;
-#endif
-    sa = (struct sockaddr *) &v4;
-    af = AF_INET;
-  }
-  else if (1 == inet_pton (AF_INET6, ctx->dns_exit, &v6.sin6_addr))
-  {
-    salen = sizeof (v6);
-    v6.sin6_family = AF_INET6;
-    v6.sin6_port = htons (53);
-#if HAVE_SOCKADDR_IN_SIN_LEN
-    v6.sin6_len = (u_char) salen;
-#endif
-    sa = (struct sockaddr *) &v6;
-    af = AF_INET6;
-  }
-  else
+  if (0 == ctx->num_servers)
   {
     GNUNET_break (0);
     return NULL;
   }
-  if (NULL == (rs = get_request_socket (ctx, af)))
-    return NULL;
-  if (NULL != rs->dnsout4)
-    dnsout = rs->dnsout4;
-  else
-    dnsout = rs->dnsout6;
-  if (NULL == dnsout)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		_("Configured DNS exit `%s' is not working / valid.\n"),
-		ctx->dns_exit);
-    return NULL;
-  }
-  memcpy (&rs->addr,
-	  sa,
-	  salen);
-  rs->addrlen = salen;
-  rs->rc = rc;
-  rs->rc_cls = rc_cls;
-  if (GNUNET_SYSERR ==
-      GNUNET_NETWORK_socket_sendto (dnsout,
-				    request,
-				    request_len, sa, salen))
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-		_("Failed to send DNS request to %s\n"),
-		GNUNET_a2s (sa, salen));
-  rs->timeout = GNUNET_TIME_relative_to_absolute (REQUEST_TIMEOUT);
+  rs = GNUNET_new (struct GNUNET_DNSSTUB_RequestSocket);
+  rs->servers = ctx->servers;
+  rs->num_servers = ctx->num_servers;
+  return start_request (ctx,
+                        rs,
+                        request,
+                        request_len,
+                        rc,
+                        rc_cls);
+}
 
-  return rs;
 
+/**
+ * Cancel DNS resolution.
+ *
+ * @param rs resolution to cancel
+ */
+void
+GNUNET_DNSSTUB_resolve_cancel (struct GNUNET_DNSSTUB_RequestSocket *rs)
+{
+  release_request (rs);
+  GNUNET_free (rs);
 }
 
 
 /**
- * Actually do the reading of a DNS packet from our UDP socket and see
- * if we have a valid, matching, pending request.
+ * Parse the IP address of a DNS server and add it to the servers
+ * of the context.
  *
- * @param rs request socket with callback details
- * @param dnsout socket to read from
- * @return #GNUNET_OK on success, #GNUNET_NO on drop, #GNUNET_SYSERR on IO-errors (closed socket)
+ * @param ctx the DNSSTUB context
+ * @param dns_ip IPv4 or IPv6 address
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a dns_ip is invalid
  */
 static int
-do_dns_read (struct GNUNET_DNSSTUB_RequestSocket *rs,
-	     struct GNUNET_NETWORK_Handle *dnsout)
+add_server (struct GNUNET_DNSSTUB_Context *ctx,
+            const char *dns_ip)
 {
-  struct sockaddr_storage addr;
-  socklen_t addrlen;
-  struct GNUNET_TUN_DnsHeader *dns;
-  ssize_t r;
-  int len;
+  struct DnsServer server;
+  struct sockaddr_in *v4 = (struct sockaddr_in *) &server.addr;
+  struct sockaddr_in6 *v6 = (struct sockaddr_in6 *) &server.addr;
 
-#ifndef MINGW
-  if (0 != ioctl (GNUNET_NETWORK_get_fd (dnsout), FIONREAD, &len))
+  memset (&server, 0, sizeof (server));
+  if (1 == inet_pton (AF_INET, dns_ip, &v4->sin_addr))
   {
-    /* conservative choice: */
-    len = UINT16_MAX;
+    server.addrlen = sizeof (struct sockaddr_in);
+    v4->sin_family = AF_INET;
+    v4->sin_port = htons (53);
+#if HAVE_SOCKADDR_IN_SIN_LEN
+    v4->sin_len = (u_char) server.addrlen;
+#endif
   }
-#else
-  /* port the code above? */
-  len = UINT16_MAX;
+  else if (1 == inet_pton (AF_INET6, dns_ip, &v6->sin6_addr))
+  {
+    server.addrlen = sizeof (struct sockaddr_in6);
+    v6->sin6_family = AF_INET6;
+    v6->sin6_port = htons (53);
+#if HAVE_SOCKADDR_IN_SIN_LEN
+    v6->sin6_len = (u_char) server.addrlen;
 #endif
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Receiving %d byte DNS reply\n",
-	      len);
+  }
+  else
   {
-    unsigned char buf[len] GNUNET_ALIGN;
-
-    addrlen = sizeof (addr);
-    memset (&addr, 0, sizeof (addr));
-    r = GNUNET_NETWORK_socket_recvfrom (dnsout,
-					buf, sizeof (buf),
-					(struct sockaddr*) &addr, &addrlen);
-    if (-1 == r)
-    {
-      GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "recvfrom");
-      GNUNET_NETWORK_socket_close (dnsout);
-      return GNUNET_SYSERR;
-    }
-    if (sizeof (struct GNUNET_TUN_DnsHeader) > r)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		  _("Received DNS response that is too small (%u bytes)"),
-		  r);
-      return GNUNET_NO;
-    }
-    dns = (struct GNUNET_TUN_DnsHeader *) buf;
-    if ( (addrlen != rs->addrlen) ||
-	 (0 != memcmp (&rs->addr,
-		       &addr,
-		       addrlen)) ||
-       (0 == GNUNET_TIME_absolute_get_remaining (rs->timeout).rel_value_us) )
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		  "Request timeout or invalid sender address; ignoring reply\n");
-      return GNUNET_NO;
-    }
-    if (NULL != rs->rc)
-      rs->rc (rs->rc_cls,
-	      rs,
-	      dns,
-	      r);
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Configured DNS exit `%s' is not working / valid.\n"),
+		dns_ip);
+    return GNUNET_SYSERR;
   }
+  GNUNET_array_append (ctx->servers,
+                       ctx->num_servers,
+                       server);
   return GNUNET_OK;
 }
 
 
 /**
- * Read a DNS response from the (unhindered) UDP-Socket
+ * Start a DNS stub resolver.
  *
- * @param cls socket to read from
- * @param tc scheduler context (must be shutdown or read ready)
+ * @param dns_ip target IP address to use, or several addresses
+ *        separated by spaces, commas or semicolons; NULL for none
+ * @return NULL on error
  */
-static void
-read_response (void *cls,
-	       const struct GNUNET_SCHEDULER_TaskContext *tc)
+struct GNUNET_DNSSTUB_Context *
+GNUNET_DNSSTUB_start (const char *dns_ip)
 {
-  struct GNUNET_DNSSTUB_RequestSocket *rs = cls;
-  struct GNUNET_NETWORK_FDSet *rset;
+  struct GNUNET_DNSSTUB_Context *ctx;
+  char *ips;
+  char *tok;
 
-  rs->read_task = NULL;
-  if (0 == (tc->reason & GNUNET_SCHEDULER_REASON_READ_READY))
+  ctx = GNUNET_new (struct GNUNET_DNSSTUB_Context);
+  ctx->pending = GNUNET_CONTAINER_multihashmap32_create (256);
+  if (NULL == dns_ip)
+    return ctx;
+  ips = GNUNET_strdup (dns_ip);
+  for (tok = strtok (ips, " ,;"); NULL != tok; tok = strtok (NULL, " ,;"))
   {
-    /* timeout or shutdown */
-    cleanup_rs (rs);
-    return;
+    if (GNUNET_OK != add_server (ctx, tok))
+    {
+      GNUNET_free (ips);
+      GNUNET_DNSSTUB_stop (ctx);
+      return NULL;
+    }
   }
-  /* read and process ready sockets */
-  if ((NULL != rs->dnsout4) &&
-      (GNUNET_NETWORK_fdset_isset (tc->read_ready, rs->dnsout4)) &&
-      (GNUNET_SYSERR == do_dns_read (rs, rs->dnsout4)))
-    rs->dnsout4 = NULL;
-  if ((NULL != rs->dnsout6) &&
-      (GNUNET_NETWORK_fdset_isset (tc->read_ready, rs->dnsout6)) &&
-      (GNUNET_SYSERR == do_dns_read (rs, rs->dnsout6)))
-    rs->dnsout6 = NULL;
-
-  /* re-schedule read task */
-  rset = GNUNET_NETWORK_fdset_create ();
-  if (NULL != rs->dnsout4)
-    GNUNET_NETWORK_fdset_set (rset, rs->dnsout4);
-  if (NULL != rs->dnsout6)
-    GNUNET_NETWORK_fdset_set (rset, rs->dnsout6);
-  rs->read_task = GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
-					       GNUNET_TIME_absolute_get_remaining (rs->timeout),
-					       rset,
-					       NULL,
-					       &read_response, rs);
-  GNUNET_NETWORK_fdset_destroy (rset);
+  GNUNET_free (ips);
+  return ctx;
 }
 
 
 /**
- * Cancel DNS resolution.
+ * Cancel a pending request during shutdown.
  *
- * @param rs resolution to cancel
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct GNUNET_DNSSTUB_RequestSocket`
+ * @return #GNUNET_OK (continue to iterate)
  */
-void
-GNUNET_DNSSTUB_resolve_cancel (struct GNUNET_DNSSTUB_RequestSocket *rs)
+static int
+free_request (void *cls,
+              uint32_t key,
+              void *value)
 {
-  rs->rc = NULL;
+  GNUNET_DNSSTUB_resolve_cancel (value);
+  return GNUNET_OK;
 }
 
 
 /**
- * Start a DNS stub resolver.
+ * Close a UDP socket of the pool.
  *
- * @param dns_ip target IP address to use
- * @return NULL on error
+ * @param us socket to close
  */
-struct GNUNET_DNSSTUB_Context *
-GNUNET_DNSSTUB_start (const char *dns_ip)
+static void
+cleanup_socket (struct UdpSocket *us)
 {
-  struct GNUNET_DNSSTUB_Context *ctx;
-
-  ctx = GNUNET_new (struct GNUNET_DNSSTUB_Context);
-  if (NULL != dns_ip)
-    ctx->dns_exit = GNUNET_strdup (dns_ip);
-  return ctx;
+  if (NULL != us->read_task)
+  {
+    GNUNET_SCHEDULER_cancel (us->read_task);
+    us->read_task = NULL;
+  }
+  if (NULL != us->sock)
+  {
+    GNUNET_NETWORK_socket_close (us->sock);
+    us->sock = NULL;
+  }
 }
 
 
 /**
- * Cleanup DNSSTUB resolver.
+ * Cleanup DNSSTUB resolver.  Pending requests are cancelled.
  *
  * @param ctx stub resolver to clean up
  */
@@ -547,13 +1476,21 @@ GNUNET_DNSSTUB_stop (struct GNUNET_DNSSTUB_Context *ctx)
 {
   unsigned int i;
 
+  GNUNET_CONTAINER_multihashmap32_iterate (ctx->pending,
+                                           &free_request,
+                                           NULL);
+  GNUNET_CONTAINER_multihashmap32_destroy (ctx->pending);
+  /* only idle connections remain */
+  while (NULL != ctx->conn_head)
+    destroy_tcp_connection (ctx->conn_head);
   for (i=0;i<DNS_SOCKET_MAX;i++)
-    cleanup_rs (&ctx->sockets[i]);
-  if (NULL != ctx->dns_exit)
   {
-    GNUNET_free (ctx->dns_exit);
-    ctx->dns_exit = NULL;
+    cleanup_socket (&ctx->sockets4[i]);
+    cleanup_socket (&ctx->sockets6[i]);
   }
+  GNUNET_array_grow (ctx->servers,
+                     ctx->num_servers,
+                     0);
   GNUNET_free (ctx);
 }
 
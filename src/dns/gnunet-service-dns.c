@@ -54,6 +54,17 @@
  */
 #define DNS_PORT 53
 
+/**
+ * How many bytes of stack do we use for parsing requests to evaluate
+ * client filters?  (Larger packets fall back to the heap.)
+ */
+#define DNS_PARSE_ARENA_SIZE (8 * 1024)
+
+/**
+ * Maximum number of client-provided answers we cache.
+ */
+#define MAX_ANSWER_CACHE_SIZE 1024
+
 
 /**
  * Generic logging shorthand
@@ -109,6 +120,61 @@ enum RequestPhase
 };
 
 
+/**
+ * Filter a client registered to restrict which requests it is shown.
+ */
+struct ClientFilter
+{
+  /**
+   * Kept in DLL.
+   */
+  struct ClientFilter *next;
+
+  /**
+   * Kept in DLL.
+   */
+  struct ClientFilter *prev;
+
+  /**
+   * Name suffixes to match, allocated at the end of this struct.
+   */
+  const char **suffixes;
+
+  /**
+   * Query types to match (host byte order), allocated at the end
+   * of this struct.
+   */
+  uint16_t *qtypes;
+
+  /**
+   * Record types to match (host byte order), allocated at the end
+   * of this struct.
+   */
+  uint16_t *rtypes;
+
+  /**
+   * Length of the @e suffixes array.
+   */
+  unsigned int suffix_count;
+
+  /**
+   * Length of the @e qtypes array.
+   */
+  unsigned int qtype_count;
+
+  /**
+   * Length of the @e rtypes array.
+   */
+  unsigned int rtype_count;
+
+  /**
+   * Options for the filter.
+   */
+  enum GNUNET_DNS_FilterFlags flags;
+
+};
+
+
 /**
  * Entry we keep for each client.
  */
@@ -129,6 +195,16 @@ struct ClientRecord
    */
   struct GNUNET_SERVER_Client *client;
 
+  /**
+   * Head of filters of the client (NULL: show all requests).
+   */
+  struct ClientFilter *filter_head;
+
+  /**
+   * Tail of filters of the client.
+   */
+  struct ClientFilter *filter_tail;
+
   /**
    * Flags for the client.
    */
@@ -137,6 +213,41 @@ struct ClientRecord
 };
 
 
+/**
+ * Answer a client provided for a query, which we may reuse for
+ * identical queries until it expires.
+ */
+struct CacheEntry
+{
+
+  /**
+   * Hash of the (lower-case) name, type and class of the query.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * The answer.
+   */
+  struct GNUNET_DNSPARSER_Packet *packet;
+
+  /**
+   * Client that provided the answer.
+   */
+  struct ClientRecord *origin;
+
+  /**
+   * Entry in the #cache_heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * When does the first record in the answer expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+};
+
+
 /**
  * Entry we keep for each active request.
  */
@@ -251,6 +362,48 @@ static uint64_t request_id_gen;
  */
 static struct GNUNET_DNSSTUB_Context *dnsstub;
 
+/**
+ * Map of query hashes to `struct CacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *answer_cache;
+
+/**
+ * Heap of `struct CacheEntry`, sorted by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *cache_heap;
+
+
+/**
+ * Remove an answer from the cache and free it.
+ *
+ * @param ce cache entry to free
+ */
+static void
+free_cache_entry (struct CacheEntry *ce)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (answer_cache,
+                                                       &ce->key,
+                                                       ce));
+  GNUNET_CONTAINER_heap_remove_node (ce->hn);
+  GNUNET_DNSPARSER_free_packet (ce->packet);
+  GNUNET_free (ce);
+}
+
+
+/**
+ * Remove expired answers from the cache.
+ */
+static void
+expire_cache (void)
+{
+  struct CacheEntry *ce;
+
+  while ( (NULL != (ce = GNUNET_CONTAINER_heap_peek (cache_heap))) &&
+          (0 == GNUNET_TIME_absolute_get_remaining (ce->expiration).rel_value_us) )
+    free_cache_entry (ce);
+}
+
 
 /**
  * We're done processing a DNS request, free associated memory.
@@ -260,6 +413,11 @@ static struct GNUNET_DNSSTUB_Context *dnsstub;
 static void
 cleanup_rr (struct RequestRecord *rr)
 {
+  if (NULL != rr->rs)
+  {
+    GNUNET_DNSSTUB_resolve_cancel (rr->rs);
+    rr->rs = NULL;
+  }
   GNUNET_free_non_null (rr->payload);
   rr->payload = NULL;
   rr->payload_length = 0;
@@ -279,6 +437,7 @@ static void
 cleanup_task (void *cls GNUNET_UNUSED,
               const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  struct CacheEntry *ce;
   unsigned int i;
 
   if (NULL != hijacker)
@@ -290,6 +449,18 @@ cleanup_task (void *cls GNUNET_UNUSED,
     GNUNET_free_non_null (helper_argv[i]);
   for (i=0;i<=UINT16_MAX;i++)
     cleanup_rr (&requests[i]);
+  if (NULL != cache_heap)
+  {
+    while (NULL != (ce = GNUNET_CONTAINER_heap_peek (cache_heap)))
+      free_cache_entry (ce);
+    GNUNET_CONTAINER_heap_destroy (cache_heap);
+    cache_heap = NULL;
+  }
+  if (NULL != answer_cache)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (answer_cache);
+    answer_cache = NULL;
+  }
   GNUNET_SERVER_notification_context_destroy (nc);
   nc = NULL;
   if (stats != NULL)
@@ -517,6 +688,383 @@ process_dns_result (void *cls,
 		    size_t r);
 
 
+/**
+ * Check if @a name is equal to @a suffix or ends with "." and
+ * @a suffix (case-insensitive).
+ *
+ * @param name name to check
+ * @param suffix suffix to look for
+ * @return #GNUNET_YES on match
+ */
+static int
+suffix_matches (const char *name,
+                const char *suffix)
+{
+  size_t nlen;
+  size_t slen;
+
+  nlen = strlen (name);
+  slen = strlen (suffix);
+  if (nlen < slen)
+    return GNUNET_NO;
+  if ( (nlen > slen) &&
+       ('.' != name[nlen - slen - 1]) )
+    return GNUNET_NO;
+  if (0 != strcasecmp (&name[nlen - slen], suffix))
+    return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Check if @a type is in the given array.
+ *
+ * @param type type to look for
+ * @param types array of types
+ * @param types_len length of @a types
+ * @return #GNUNET_YES if found
+ */
+static int
+type_in (uint16_t type,
+         const uint16_t *types,
+         unsigned int types_len)
+{
+  unsigned int i;
+
+  for (i=0;i<types_len;i++)
+    if (type == types[i])
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Check if any of the given records has a type in @a f's
+ * record type list.
+ *
+ * @param f filter to evaluate
+ * @param records records to check
+ * @param num_records length of @a records
+ * @return #GNUNET_YES on match
+ */
+static int
+records_match (const struct ClientFilter *f,
+               const struct GNUNET_DNSPARSER_Record *records,
+               unsigned int num_records)
+{
+  unsigned int i;
+
+  for (i=0;i<num_records;i++)
+    if (GNUNET_YES == type_in (records[i].type,
+                               f->rtypes,
+                               f->rtype_count))
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Check if the DNS packet @a p matches filter @a f.
+ *
+ * @param f filter to evaluate
+ * @param p parsed request
+ * @return #GNUNET_YES on match
+ */
+static int
+filter_matches (const struct ClientFilter *f,
+                const struct GNUNET_DNSPARSER_Packet *p)
+{
+  const struct GNUNET_DNSPARSER_Query *q;
+  unsigned int i;
+  unsigned int j;
+  int match;
+
+  if ( (0 != f->suffix_count) ||
+       (0 != f->qtype_count) )
+  {
+    match = GNUNET_NO;
+    for (i=0;(GNUNET_NO == match) && (i<p->num_queries);i++)
+    {
+      q = &p->queries[i];
+      if ( (0 != f->qtype_count) &&
+           (GNUNET_NO == type_in (q->type,
+                                  f->qtypes,
+                                  f->qtype_count)) )
+        continue;
+      if (0 == f->suffix_count)
+        match = GNUNET_YES;
+      for (j=0;(GNUNET_NO == match) && (j<f->suffix_count);j++)
+        match = suffix_matches (q->name,
+                                f->suffixes[j]);
+    }
+    if (GNUNET_NO == match)
+      return GNUNET_NO;
+  }
+  if (0 == f->rtype_count)
+    return GNUNET_YES;
+  if ( (GNUNET_YES == records_match (f, p->answers, p->num_answers)) ||
+       (GNUNET_YES == records_match (f, p->authority_records, p->num_authority_records)) ||
+       (GNUNET_YES == records_match (f, p->additional_records, p->num_additional_records)) )
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Check if client @a cr wants to see the DNS packet @a p.
+ *
+ * @param cr client to check
+ * @param p parsed request, NULL if the request could not be parsed
+ * @return #GNUNET_YES if the client should see the request
+ */
+static int
+client_wants (const struct ClientRecord *cr,
+              const struct GNUNET_DNSPARSER_Packet *p)
+{
+  const struct ClientFilter *f;
+
+  if ( (NULL == cr->filter_head) ||
+       (NULL == p) )
+    return GNUNET_YES;
+  for (f = cr->filter_head; NULL != f; f = f->next)
+    if (GNUNET_YES == filter_matches (f, p))
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Add all clients with the given @a flag whose filters match
+ * the request to the wait list of @a rr.  The request is only
+ * parsed if some of these clients have filters.
+ *
+ * @param rr request to process
+ * @param flag flag the clients must have set
+ */
+static void
+add_clients (struct RequestRecord *rr,
+             enum GNUNET_DNS_Flags flag)
+{
+  char mem[DNS_PARSE_ARENA_SIZE];
+  struct GNUNET_DNSPARSER_Arena arena;
+  struct GNUNET_DNSPARSER_Packet *p;
+  struct ClientRecord *cr;
+  int parsed;
+
+  parsed = GNUNET_NO;
+  p = NULL;
+  for (cr = clients_head; NULL != cr; cr = cr->next)
+  {
+    if (0 == (cr->flags & flag))
+      continue;
+    if ( (NULL != cr->filter_head) &&
+         (GNUNET_NO == parsed) )
+    {
+      GNUNET_DNSPARSER_arena_init (&arena, mem, sizeof (mem));
+      p = GNUNET_DNSPARSER_parse_arena (&arena,
+                                        rr->payload,
+                                        rr->payload_length);
+      parsed = GNUNET_YES;
+    }
+    if (GNUNET_NO == client_wants (cr, p))
+    {
+      GNUNET_STATISTICS_update (stats,
+                                gettext_noop ("# DNS requests not shown to client (filter mismatch)"),
+                                1, GNUNET_NO);
+      continue;
+    }
+    GNUNET_array_append (rr->client_wait_list,
+                         rr->client_wait_list_length,
+                         cr);
+  }
+  if (GNUNET_YES == parsed)
+    GNUNET_DNSPARSER_arena_release (&arena);
+}
+
+
+/**
+ * Compute the cache key for a query.
+ *
+ * @param q query to hash
+ * @param key set to the key
+ */
+static void
+get_cache_key (const struct GNUNET_DNSPARSER_Query *q,
+               struct GNUNET_HashCode *key)
+{
+  char buf[GNUNET_DNSPARSER_MAX_NAME_LENGTH + 1 + 2 * sizeof (uint16_t)];
+  uint16_t nbo;
+  size_t nlen;
+  size_t i;
+
+  nlen = strlen (q->name);
+  if (nlen > GNUNET_DNSPARSER_MAX_NAME_LENGTH)
+    nlen = GNUNET_DNSPARSER_MAX_NAME_LENGTH;
+  /* DNS names compare case-insensitively in ASCII only (RFC 4343) */
+  for (i=0;i<nlen;i++)
+    buf[i] = tolower ((unsigned char) q->name[i]);
+  buf[nlen] = '\0';
+  nbo = htons (q->type);
+  memcpy (&buf[nlen + 1], &nbo, sizeof (nbo));
+  nbo = htons (q->dns_traffic_class);
+  memcpy (&buf[nlen + 1 + sizeof (nbo)], &nbo, sizeof (nbo));
+  GNUNET_CRYPTO_hash (buf,
+                      nlen + 1 + 2 * sizeof (uint16_t),
+                      key);
+}
+
+
+/**
+ * Answer the query in @a rr from the cache, if possible.
+ *
+ * @param rr request in #RP_REQUEST_MONITOR phase
+ * @return #GNUNET_YES if @a rr now contains the answer
+ */
+static int
+answer_from_cache (struct RequestRecord *rr)
+{
+  char mem[DNS_PARSE_ARENA_SIZE];
+  char buf[UINT16_MAX];
+  struct GNUNET_DNSPARSER_Arena arena;
+  struct GNUNET_DNSPARSER_Packet *p;
+  struct GNUNET_HashCode key;
+  struct CacheEntry *ce;
+  char *cached_name;
+  size_t buf_len;
+  int ret;
+
+  if (0 == GNUNET_CONTAINER_multihashmap_size (answer_cache))
+    return GNUNET_NO;
+  expire_cache ();
+  GNUNET_DNSPARSER_arena_init (&arena, mem, sizeof (mem));
+  p = GNUNET_DNSPARSER_parse_arena (&arena,
+                                    rr->payload,
+                                    rr->payload_length);
+  if ( (NULL == p) ||
+       (1 != p->num_queries) ||
+       (0 != p->flags.query_or_response) )
+  {
+    GNUNET_DNSPARSER_arena_release (&arena);
+    return GNUNET_NO;
+  }
+  get_cache_key (&p->queries[0], &key);
+  ce = GNUNET_CONTAINER_multihashmap_get (answer_cache, &key);
+  if (NULL == ce)
+  {
+    GNUNET_DNSPARSER_arena_release (&arena);
+    return GNUNET_NO;
+  }
+  /* echo the request's ID and spelling of the name; the record
+     expiration times make the TTLs count down */
+  ce->packet->id = p->id;
+  cached_name = ce->packet->queries[0].name;
+  ce->packet->queries[0].name = p->queries[0].name;
+  ret = GNUNET_DNSPARSER_pack_to_buffer (ce->packet,
+                                         buf,
+                                         sizeof (buf),
+                                         &buf_len);
+  ce->packet->queries[0].name = cached_name;
+  GNUNET_DNSPARSER_arena_release (&arena);
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_break (0);
+    free_cache_entry (ce);
+    return GNUNET_NO;
+  }
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# DNS requests answered from cache"),
+                            1, GNUNET_NO);
+  GNUNET_free_non_null (rr->payload);
+  rr->payload = GNUNET_malloc (buf_len);
+  memcpy (rr->payload, buf, buf_len);
+  rr->payload_length = buf_len;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Client @a cr answered a query; if it asked for its answers to be
+ * cached, remember the answer.
+ *
+ * @param cr client that provided the answer
+ * @param payload the answer
+ * @param payload_length number of bytes in @a payload
+ */
+static void
+cache_answer (struct ClientRecord *cr,
+              const char *payload,
+              size_t payload_length)
+{
+  const struct ClientFilter *f;
+  struct GNUNET_DNSPARSER_Packet *p;
+  struct GNUNET_TIME_Absolute expiration;
+  struct GNUNET_HashCode key;
+  struct CacheEntry *ce;
+  unsigned int i;
+
+  for (f = cr->filter_head; NULL != f; f = f->next)
+    if (0 != (f->flags & GNUNET_DNS_FILTER_FLAG_CACHE_ANSWERS))
+      break;
+  if (NULL == f)
+    return;
+  p = GNUNET_DNSPARSER_parse (payload, payload_length);
+  if (NULL == p)
+    return;
+  if ( (1 != p->num_queries) ||
+       (0 == p->num_answers) ||
+       (GNUNET_TUN_DNS_RETURN_CODE_NO_ERROR != p->flags.return_code) )
+  {
+    GNUNET_DNSPARSER_free_packet (p);
+    return;
+  }
+  for (f = cr->filter_head; NULL != f; f = f->next)
+    if ( (0 != (f->flags & GNUNET_DNS_FILTER_FLAG_CACHE_ANSWERS)) &&
+         (GNUNET_YES == filter_matches (f, p)) )
+      break;
+  if (NULL == f)
+  {
+    GNUNET_DNSPARSER_free_packet (p);
+    return;
+  }
+  expiration = GNUNET_TIME_UNIT_FOREVER_ABS;
+  for (i=0;i<p->num_answers;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->answers[i].expiration_time);
+  for (i=0;i<p->num_authority_records;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->authority_records[i].expiration_time);
+  for (i=0;i<p->num_additional_records;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->additional_records[i].expiration_time);
+  if (0 == GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us / 1000LL / 1000LL)
+  {
+    /* TTL of zero, must not be cached */
+    GNUNET_DNSPARSER_free_packet (p);
+    return;
+  }
+  get_cache_key (&p->queries[0], &key);
+  ce = GNUNET_CONTAINER_multihashmap_get (answer_cache, &key);
+  if (NULL != ce)
+    free_cache_entry (ce);
+  expire_cache ();
+  if (MAX_ANSWER_CACHE_SIZE <= GNUNET_CONTAINER_multihashmap_size (answer_cache))
+    free_cache_entry (GNUNET_CONTAINER_heap_peek (cache_heap));
+  ce = GNUNET_new (struct CacheEntry);
+  ce->key = key;
+  ce->packet = p;
+  ce->origin = cr;
+  ce->expiration = expiration;
+  ce->hn = GNUNET_CONTAINER_heap_insert (cache_heap,
+                                         ce,
+                                         expiration.abs_value_us);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (answer_cache,
+                                                    &key,
+                                                    ce,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+}
+
+
 /**
  * A client has completed its processing for this
  * request.  Move on.
@@ -526,7 +1074,6 @@ process_dns_result (void *cls,
 static void
 next_phase (struct RequestRecord *rr)
 {
-  struct ClientRecord *cr;
   int nz;
   unsigned int j;
   socklen_t salen;
@@ -559,24 +1106,19 @@ next_phase (struct RequestRecord *rr)
   {
   case RP_INIT:
     rr->phase = RP_REQUEST_MONITOR;
-    for (cr = clients_head; NULL != cr; cr = cr->next)
-    {
-      if (0 != (cr->flags & GNUNET_DNS_FLAG_REQUEST_MONITOR))
-	GNUNET_array_append (rr->client_wait_list,
-			     rr->client_wait_list_length,
-			     cr);
-    }
+    add_clients (rr, GNUNET_DNS_FLAG_REQUEST_MONITOR);
     next_phase (rr);
     return;
   case RP_REQUEST_MONITOR:
-    rr->phase = RP_QUERY;
-    for (cr = clients_head; NULL != cr; cr = cr->next)
+    if (GNUNET_YES == answer_from_cache (rr))
     {
-      if (0 != (cr->flags & GNUNET_DNS_FLAG_PRE_RESOLUTION))
-	GNUNET_array_append (rr->client_wait_list,
-			     rr->client_wait_list_length,
-			     cr);
+      /* skip pre-resolution clients and the Internet */
+      rr->phase = RP_INTERNET_DNS;
+      next_phase (rr);
+      return;
     }
+    rr->phase = RP_QUERY;
+    add_clients (rr, GNUNET_DNS_FLAG_PRE_RESOLUTION);
     next_phase (rr);
     return;
   case RP_QUERY:
@@ -611,24 +1153,12 @@ next_phase (struct RequestRecord *rr)
     return;
   case RP_INTERNET_DNS:
     rr->phase = RP_MODIFY;
-    for (cr = clients_head; NULL != cr; cr = cr->next)
-    {
-      if (0 != (cr->flags & GNUNET_DNS_FLAG_POST_RESOLUTION))
-	GNUNET_array_append (rr->client_wait_list,
-			     rr->client_wait_list_length,
-			     cr);
-    }
+    add_clients (rr, GNUNET_DNS_FLAG_POST_RESOLUTION);
     next_phase (rr);
     return;
   case RP_MODIFY:
     rr->phase = RP_RESPONSE_MONITOR;
-    for (cr = clients_head; NULL != cr; cr = cr->next)
-    {
-      if (0 != (cr->flags & GNUNET_DNS_FLAG_RESPONSE_MONITOR))
-	GNUNET_array_append (rr->client_wait_list,
-			     rr->client_wait_list_length,
-			     cr);
-    }
+    add_clients (rr, GNUNET_DNS_FLAG_RESPONSE_MONITOR);
     next_phase (rr);
     return;
  case RP_RESPONSE_MONITOR:
@@ -645,6 +1175,28 @@ next_phase (struct RequestRecord *rr)
 }
 
 
+/**
+ * Remove cached answers provided by a client that disconnected.
+ *
+ * @param cls the `struct ClientRecord` of the client
+ * @param key unused
+ * @param value a `struct CacheEntry`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+purge_client_answers (void *cls,
+                      const struct GNUNET_HashCode *key,
+                      void *value)
+{
+  struct ClientRecord *cr = cls;
+  struct CacheEntry *ce = value;
+
+  if (ce->origin == cr)
+    free_cache_entry (ce);
+  return GNUNET_OK;
+}
+
+
 /**
  * A client disconnected, clean up after it.
  *
@@ -655,6 +1207,7 @@ static void
 client_disconnect (void *cls, struct GNUNET_SERVER_Client *client)
 {
   struct ClientRecord *cr;
+  struct ClientFilter *f;
   struct RequestRecord *rr;
   unsigned int i;
   unsigned int j;
@@ -681,6 +1234,16 @@ client_disconnect (void *cls, struct GNUNET_SERVER_Client *client)
 	  }
 	}
       }
+      GNUNET_CONTAINER_multihashmap_iterate (answer_cache,
+                                             &purge_client_answers,
+                                             cr);
+      while (NULL != (f = cr->filter_head))
+      {
+        GNUNET_CONTAINER_DLL_remove (cr->filter_head,
+                                     cr->filter_tail,
+                                     f);
+        GNUNET_free (f);
+      }
       GNUNET_free (cr);
       return;
     }
@@ -723,6 +1286,7 @@ process_dns_result (void *cls,
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Got a response from the stub resolver for DNS request %llu intercepted locally!\n",
        (unsigned long long) rr->request_id);
+  rr->rs = NULL;
   GNUNET_free_non_null (rr->payload);
   rr->payload = GNUNET_malloc (r);
   memcpy (rr->payload, dns, r);
@@ -758,6 +1322,107 @@ handle_client_init (void *cls GNUNET_UNUSED,
 }
 
 
+/**
+ * A client registered a filter.  Remember it.
+ *
+ * @param cls unused
+ * @param client the client
+ * @param message the filter message
+ */
+static void
+handle_client_filter (void *cls GNUNET_UNUSED,
+                      struct GNUNET_SERVER_Client *client,
+                      const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_DNS_Filter *fm;
+  struct ClientRecord *cr;
+  struct ClientFilter *f;
+  const uint16_t *types;
+  const char *names;
+  char *copy;
+  uint16_t msize;
+  size_t names_size;
+  size_t off;
+  size_t slen;
+  unsigned int qtype_count;
+  unsigned int rtype_count;
+  unsigned int suffix_count;
+  unsigned int i;
+
+  for (cr = clients_head; NULL != cr; cr = cr->next)
+    if (cr->client == client)
+      break;
+  msize = ntohs (message->size);
+  if ( (NULL == cr) ||
+       (msize < sizeof (struct GNUNET_DNS_Filter)) )
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  fm = (const struct GNUNET_DNS_Filter *) message;
+  qtype_count = ntohs (fm->qtype_count);
+  rtype_count = ntohs (fm->rtype_count);
+  suffix_count = ntohs (fm->suffix_count);
+  if (msize < sizeof (struct GNUNET_DNS_Filter) +
+      (qtype_count + rtype_count) * sizeof (uint16_t))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  types = (const uint16_t *) &fm[1];
+  names = (const char *) &types[qtype_count + rtype_count];
+  names_size = msize - sizeof (struct GNUNET_DNS_Filter)
+    - (qtype_count + rtype_count) * sizeof (uint16_t);
+  off = 0;
+  for (i=0;i<suffix_count;i++)
+  {
+    if (off >= names_size)
+      break;
+    slen = strnlen (&names[off], names_size - off);
+    if ( (0 == slen) ||
+         (slen == names_size - off) )
+      break;
+    off += slen + 1;
+  }
+  if ( (i != suffix_count) ||
+       (off != names_size) )
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  f = GNUNET_malloc (sizeof (struct ClientFilter)
+                     + suffix_count * sizeof (const char *)
+                     + (qtype_count + rtype_count) * sizeof (uint16_t)
+                     + names_size);
+  f->suffixes = (const char **) &f[1];
+  f->qtypes = (uint16_t *) &f->suffixes[suffix_count];
+  f->rtypes = &f->qtypes[qtype_count];
+  copy = (char *) &f->rtypes[rtype_count];
+  memcpy (copy, names, names_size);
+  f->suffix_count = suffix_count;
+  f->qtype_count = qtype_count;
+  f->rtype_count = rtype_count;
+  f->flags = (enum GNUNET_DNS_FilterFlags) ntohl (fm->flags);
+  for (i=0;i<qtype_count;i++)
+    f->qtypes[i] = ntohs (types[i]);
+  for (i=0;i<rtype_count;i++)
+    f->rtypes[i] = ntohs (types[qtype_count + i]);
+  off = 0;
+  for (i=0;i<suffix_count;i++)
+  {
+    f->suffixes[i] = &copy[off];
+    off += strlen (&copy[off]) + 1;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (cr->filter_head,
+                                    cr->filter_tail,
+                                    f);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
 /**
  * We got a response from a client.
  *
@@ -772,6 +1437,7 @@ handle_client_response (void *cls GNUNET_UNUSED,
 {
   const struct GNUNET_DNS_Response *resp;
   struct RequestRecord *rr;
+  struct ClientRecord *cr;
   unsigned int i;
   uint16_t msize;
   uint16_t off;
@@ -803,6 +1469,7 @@ handle_client_response (void *cls GNUNET_UNUSED,
       continue;
     if (rr->client_wait_list[i]->client != client)
       continue;
+    cr = rr->client_wait_list[i];
     rr->client_wait_list[i] = NULL;
     switch (ntohl (resp->drop_flag))
     {
@@ -840,6 +1507,9 @@ handle_client_response (void *cls GNUNET_UNUSED,
 	   (rr->payload_length > sizeof (struct GNUNET_TUN_DnsHeader)) &&
 	   ((struct GNUNET_TUN_DnsFlags*)&(((struct GNUNET_TUN_DnsHeader*) rr->payload)->flags))->query_or_response == 1)
       {
+        cache_answer (cr,
+                      rr->payload,
+                      rr->payload_length);
 	rr->phase = RP_INTERNET_DNS;
 	GNUNET_array_grow (rr->client_wait_list,
 			   rr->client_wait_list_length,
@@ -1030,6 +1700,7 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
     /* callback, cls, type, size */
     {&handle_client_init, NULL, GNUNET_MESSAGE_TYPE_DNS_CLIENT_INIT,
      sizeof (struct GNUNET_DNS_Register)},
+    {&handle_client_filter, NULL, GNUNET_MESSAGE_TYPE_DNS_CLIENT_FILTER, 0},
     {&handle_client_response, NULL, GNUNET_MESSAGE_TYPE_DNS_CLIENT_RESPONSE, 0},
     {NULL, NULL, 0, 0}
   };
@@ -1046,6 +1717,9 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   cfg = cfg_;
   stats = GNUNET_STATISTICS_create ("dns", cfg);
   nc = GNUNET_SERVER_notification_context_create (server, 1);
+  answer_cache = GNUNET_CONTAINER_multihashmap_create (MAX_ANSWER_CACHE_SIZE,
+                                                       GNUNET_NO);
+  cache_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
                                 &cleanup_task,
                                 cls);
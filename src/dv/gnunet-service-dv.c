@@ -210,10 +210,22 @@ struct DirectNeighbor
   struct GNUNET_CONTAINER_MultiPeerMap *neighbor_table_consensus;
 
   /**
-   * Our current (exposed) routing table as a set.
+   * Our current (exposed) routing table as a set.  Created when the
+   * neighbor becomes direct and kept up-to-date as our routes change,
+   * so that each set union can commit it right away.
    */
   struct GNUNET_SET_Handle *my_set;
 
+  /**
+   * Head of the DLL of routes (in #all_routes) going via this neighbor.
+   */
+  struct Route *routes_head;
+
+  /**
+   * Tail of the DLL of routes (in #all_routes) going via this neighbor.
+   */
+  struct Route *routes_tail;
+
   /**
    * Handle for our current active set union operation.
    */
@@ -260,9 +272,10 @@ struct DirectNeighbor
   struct Route *direct_route;
 
   /**
-   * Flag set within 'check_target_removed' to trigger full global route refresh.
+   * #GNUNET_YES once @e my_set contains all of our routes; until
+   * then, #build_set() is still adding them.
    */
-  int target_removed;
+  int set_built;
 
   /**
    * Our distance to this peer, 0 for unknown.
@@ -290,6 +303,16 @@ struct DirectNeighbor
 struct Route
 {
 
+  /**
+   * Kept in a DLL by next hop.
+   */
+  struct Route *next;
+
+  /**
+   * Kept in a DLL by next hop.
+   */
+  struct Route *prev;
+
   /**
    * Which peer do we need to forward the message to?
    */
@@ -388,6 +411,12 @@ static struct GNUNET_ATS_PerformanceHandle *ats;
  */
 static struct GNUNET_SCHEDULER_Task * rr_task;
 
+/**
+ * Targets for which we lost or worsened a route and #rr_task should
+ * look for alternatives; values are NULL.
+ */
+static struct GNUNET_CONTAINER_MultiPeerMap *refresh_targets;
+
 /**
  * #GNUNET_YES if we are shutting down.
  */
@@ -740,6 +769,86 @@ get_consensus_slot (uint32_t distance)
 }
 
 
+/**
+ * Closure for #update_neighbor_set().
+ */
+struct SetUpdateContext
+{
+  /**
+   * Target added to or removed from the consensus sets.
+   */
+  const struct Target *target;
+
+  /**
+   * #GNUNET_YES to add @e target, #GNUNET_NO to remove it.
+   */
+  int add;
+};
+
+
+/**
+ * Add a target to or remove it from the set we expose to a direct
+ * neighbor.  The neighbor itself is never part of its set.
+ *
+ * @param cls the `struct SetUpdateContext`
+ * @param key peer identity of the neighbor
+ * @param value the `struct DirectNeighbor`
+ * @return #GNUNET_YES to continue iteration
+ */
+static int
+update_neighbor_set (void *cls,
+                     const struct GNUNET_PeerIdentity *key,
+                     void *value)
+{
+  struct SetUpdateContext *suc = cls;
+  struct DirectNeighbor *neighbor = value;
+  struct GNUNET_SET_Element element;
+
+  if (NULL == neighbor->my_set)
+    return GNUNET_YES;
+  if (0 == memcmp (&suc->target->peer, &neighbor->peer, sizeof (neighbor->peer)))
+    return GNUNET_YES;
+  element.size = sizeof (struct Target);
+  element.element_type = htons (0);
+  element.data = suc->target;
+  if (GNUNET_YES == suc->add)
+  {
+    GNUNET_SET_add_element (neighbor->my_set, &element, NULL, NULL);
+    neighbor->consensus_elements++;
+  }
+  else
+  {
+    GNUNET_SET_remove_element (neighbor->my_set, &element, NULL, NULL);
+    neighbor->consensus_elements--;
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * A route entered or left the consensus sets, update the sets we
+ * expose to our direct neighbors accordingly.
+ *
+ * @param route the route
+ * @param add #GNUNET_YES if the route was added, #GNUNET_NO if removed
+ */
+static void
+update_neighbor_sets (struct Route *route,
+                      int add)
+{
+  struct SetUpdateContext suc;
+
+  if ( (NULL == direct_neighbors) ||
+       (0 == memcmp (&route->target.peer, &my_identity, sizeof (my_identity))) )
+    return;
+  suc.target = &route->target;
+  suc.add = add;
+  GNUNET_CONTAINER_multipeermap_iterate (direct_neighbors,
+                                         &update_neighbor_set,
+                                         &suc);
+}
+
+
 /**
  * Allocate a slot in the consensus set for a route.
  *
@@ -762,6 +871,7 @@ allocate_route (struct Route *route,
   route->set_offset = i;
   consensi[distance].targets[i] = route;
   route->target.distance = htonl (distance);
+  update_neighbor_sets (route, GNUNET_YES);
 }
 
 
@@ -776,11 +886,54 @@ release_route (struct Route *route)
   if (UINT_MAX == route->set_offset)
     return;
   GNUNET_assert (ntohl (route->target.distance) < DEFAULT_FISHEYE_DEPTH);
+  update_neighbor_sets (route, GNUNET_NO);
   consensi[ntohl (route->target.distance)].targets[route->set_offset] = NULL;
   route->set_offset = UINT_MAX; /* indicate invalid slot */
 }
 
 
+/**
+ * Change the next hop of a route in #all_routes.
+ *
+ * @param route the route
+ * @param neighbor the new next hop
+ */
+static void
+set_next_hop (struct Route *route,
+              struct DirectNeighbor *neighbor)
+{
+  if (NULL != route->next_hop)
+    GNUNET_CONTAINER_DLL_remove (route->next_hop->routes_head,
+                                 route->next_hop->routes_tail,
+                                 route);
+  route->next_hop = neighbor;
+  GNUNET_CONTAINER_DLL_insert (neighbor->routes_head,
+                               neighbor->routes_tail,
+                               route);
+}
+
+
+/**
+ * Remove a route from #all_routes, tell the plugin and free it.
+ *
+ * @param route the route
+ */
+static void
+destroy_route (struct Route *route)
+{
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multipeermap_remove (all_routes,
+                                                       &route->target.peer,
+                                                       route));
+  GNUNET_CONTAINER_DLL_remove (route->next_hop->routes_head,
+                               route->next_hop->routes_tail,
+                               route);
+  release_route (route);
+  send_disconnect_to_plugin (&route->target.peer);
+  GNUNET_free (route);
+}
+
+
 /**
  * Move a route from one consensus set to another.
  *
@@ -797,8 +950,9 @@ move_route (struct Route *route,
 
 
 /**
- * Initialize this neighbors 'my_set' and when done give
- * it to the pending set operation for execution.
+ * Initialize this neighbors 'my_set' with our routes.  When done,
+ * give it to the pending set operation for execution, if any.
+ * Afterwards, the set is updated as our routes change.
  *
  * Add a single element to the set per call:
  *
@@ -837,13 +991,13 @@ build_set (void *cls)
   {
     /* we have added all elements to the set, run the operation */
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Finished building my SET for peer `%s' with %u elements, committing\n",
+		"Finished building my SET for peer `%s' with %u elements\n",
 		GNUNET_i2s (&neighbor->peer),
 		neighbor->consensus_elements);
-    GNUNET_SET_commit (neighbor->set_op,
-		       neighbor->my_set);
-    GNUNET_SET_destroy (neighbor->my_set);
-    neighbor->my_set = NULL;
+    neighbor->set_built = GNUNET_YES;
+    if (NULL != neighbor->set_op)
+      GNUNET_SET_commit (neighbor->set_op,
+                         neighbor->my_set);
     return;
   }
 
@@ -897,15 +1051,7 @@ handle_direct_connect (struct DirectNeighbor *neighbor)
   route = GNUNET_CONTAINER_multipeermap_get (all_routes,
 					     &neighbor->peer);
   if (NULL != route)
-  {
-    GNUNET_assert (GNUNET_YES ==
-		   GNUNET_CONTAINER_multipeermap_remove (all_routes,
-                                                         &neighbor->peer,
-                                                         route));
-    send_disconnect_to_plugin (&neighbor->peer);
-    release_route (route);
-    GNUNET_free (route);
-  }
+    destroy_route (route);
 
   neighbor->direct_route = GNUNET_new (struct Route);
   neighbor->direct_route->next_hop = neighbor;
@@ -916,6 +1062,15 @@ handle_direct_connect (struct DirectNeighbor *neighbor)
               "Adding direct route to %s\n",
               GNUNET_i2s (&neighbor->direct_route->target.peer));
 
+  /* fill the set we expose to the neighbor, it is then kept
+     up-to-date by allocate_route() and release_route() */
+  neighbor->my_set = GNUNET_SET_create (cfg,
+                                        GNUNET_SET_OPERATION_UNION);
+  neighbor->set_built = GNUNET_NO;
+  neighbor->consensus_insertion_offset = 0;
+  neighbor->consensus_insertion_distance = 0;
+  neighbor->consensus_elements = 0;
+  build_set (neighbor);
 
   /* construct session ID seed as XOR of both peer's identities */
   GNUNET_CRYPTO_hash (&my_identity, sizeof (my_identity), &h1);
@@ -1041,7 +1196,7 @@ add_new_route (struct Target *target,
   struct Route *route;
 
   route = GNUNET_new (struct Route);
-  route->next_hop = neighbor;
+  set_next_hop (route, neighbor);
   route->target.peer = target->peer;
   allocate_route (route, ntohl (target->distance) + 1);
   GNUNET_assert (GNUNET_YES ==
@@ -1087,7 +1242,7 @@ check_possible_route (void *cls,
     {
       /* via 'target' is cheaper than the existing route; switch to alternative route! */
       move_route (route, ntohl (target->distance) + 1);
-      route->next_hop = neighbor;
+      set_next_hop (route, neighbor);
       send_distance_change_to_plugin (&target->peer,
                                       ntohl (target->distance) + 1,
                                       neighbor->network);
@@ -1102,34 +1257,94 @@ check_possible_route (void *cls,
 
 
 /**
- * Multipeermap iterator for finding routes that were previously
- * "hidden" due to a better route (called after a disconnect event).
+ * Closure for #find_best_neighbor().
+ */
+struct BestNeighborContext
+{
+  /**
+   * Target we look for a route to.
+   */
+  const struct GNUNET_PeerIdentity *peer;
+
+  /**
+   * Neighbor with the shortest route to @e peer so far, or NULL.
+   */
+  struct DirectNeighbor *neighbor;
+
+  /**
+   * Entry for @e peer in the table of @e neighbor.
+   */
+  struct Target *target;
+};
+
+
+/**
+ * Multipeermap iterator for finding the direct neighbor with the
+ * shortest route to a target.
  *
- * @param cls NULL
+ * @param cls the `struct BestNeighborContext`
  * @param key peer identity of the given direct neighbor
- * @param value a `struct DirectNeighbor` to check for additional routes
+ * @param value a `struct DirectNeighbor` to check
  * @return #GNUNET_YES to continue iteration
  */
 static int
-refresh_routes (void *cls,
-		const struct GNUNET_PeerIdentity *key,
-		void *value)
+find_best_neighbor (void *cls,
+                    const struct GNUNET_PeerIdentity *key,
+                    void *value)
 {
+  struct BestNeighborContext *bnc = cls;
   struct DirectNeighbor *neighbor = value;
+  struct Target *target;
 
   if ( (GNUNET_YES != neighbor->connected) ||
-       (DIRECT_NEIGHBOR_COST != neighbor->distance) )
+       (DIRECT_NEIGHBOR_COST != neighbor->distance) ||
+       (NULL == neighbor->neighbor_table) )
     return GNUNET_YES;
-  if (NULL != neighbor->neighbor_table)
-    GNUNET_CONTAINER_multipeermap_iterate (neighbor->neighbor_table,
-					   &check_possible_route,
-					   neighbor);
+  target = GNUNET_CONTAINER_multipeermap_get (neighbor->neighbor_table,
+                                              bnc->peer);
+  if (NULL == target)
+    return GNUNET_YES;
+  if ( (NULL == bnc->target) ||
+       (ntohl (target->distance) < ntohl (bnc->target->distance)) )
+  {
+    bnc->neighbor = neighbor;
+    bnc->target = target;
+  }
   return GNUNET_YES;
 }
 
 
 /**
- * Task to run #refresh_routes() on all direct neighbours.
+ * Multipeermap iterator for finding routes to a target that were
+ * previously "hidden" due to a better route (called after the route
+ * was lost or became longer).
+ *
+ * @param cls NULL
+ * @param key peer identity of the target
+ * @param value NULL
+ * @return #GNUNET_YES to continue iteration
+ */
+static int
+refresh_route (void *cls,
+               const struct GNUNET_PeerIdentity *key,
+               void *value)
+{
+  struct BestNeighborContext bnc;
+
+  bnc.peer = key;
+  bnc.neighbor = NULL;
+  bnc.target = NULL;
+  GNUNET_CONTAINER_multipeermap_iterate (direct_neighbors,
+                                         &find_best_neighbor,
+                                         &bnc);
+  if (NULL != bnc.neighbor)
+    check_possible_route (bnc.neighbor, key, bnc.target);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Task to run #refresh_route() on all targets that need it.
  *
  * @param cls NULL
  * @param tc unused
@@ -1138,55 +1353,39 @@ static void
 refresh_routes_task (void *cls,
                      const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  struct GNUNET_CONTAINER_MultiPeerMap *targets;
+
   rr_task = NULL;
-  GNUNET_CONTAINER_multipeermap_iterate (direct_neighbors,
-					 &refresh_routes,
+  targets = refresh_targets;
+  refresh_targets = GNUNET_CONTAINER_multipeermap_create (16, GNUNET_NO);
+  GNUNET_CONTAINER_multipeermap_iterate (targets,
+					 &refresh_route,
                                          NULL);
+  GNUNET_CONTAINER_multipeermap_destroy (targets);
 }
 
 
 /**
- * Asynchronously run #refresh_routes() at the next opportunity
- * on all direct neighbours.
+ * Asynchronously run #refresh_route() for @a peer at the next
+ * opportunity, as we lost our route to it or it got longer.
+ *
+ * @param peer the target
  */
 static void
-schedule_refresh_routes ()
+schedule_refresh_route (const struct GNUNET_PeerIdentity *peer)
 {
+  if (GNUNET_YES == in_shutdown)
+    return;
+  (void) GNUNET_CONTAINER_multipeermap_put (refresh_targets,
+                                            peer,
+                                            NULL,
+                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY);
   if (NULL == rr_task)
     rr_task = GNUNET_SCHEDULER_add_now (&refresh_routes_task,
                                         NULL);
 }
 
 
-/**
- * Multipeermap iterator for freeing routes that go via a particular
- * neighbor that disconnected and is thus no longer available.
- *
- * @param cls the direct neighbor that is now unavailable
- * @param key key value stored under
- * @param value a `struct Route` that may or may not go via neighbor
- *
- * @return #GNUNET_YES to continue iteration, #GNUNET_NO to stop
- */
-static int
-cull_routes (void *cls,
-	     const struct GNUNET_PeerIdentity *key,
-	     void *value)
-{
-  struct DirectNeighbor *neighbor = cls;
-  struct Route *route = value;
-
-  if (route->next_hop != neighbor)
-    return GNUNET_YES; /* not affected */
-  GNUNET_assert (GNUNET_YES ==
-		 GNUNET_CONTAINER_multipeermap_remove (all_routes, key, value));
-  release_route (route);
-  send_disconnect_to_plugin (&route->target.peer);
-  GNUNET_free (route);
-  return GNUNET_YES;
-}
-
-
 /**
  * Handle the case that a direct connection to a peer is
  * disrupted.  Remove all routes via that peer and
@@ -1198,12 +1397,23 @@ cull_routes (void *cls,
 static void
 handle_direct_disconnect (struct DirectNeighbor *neighbor)
 {
+  struct Route *route;
+
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Culling routes via %s due to direct disconnect\n",
 	      GNUNET_i2s (&neighbor->peer));
-  GNUNET_CONTAINER_multipeermap_iterate (all_routes,
-					 &cull_routes,
-                                         neighbor);
+  /* destroy the set first, no need to remove the routes from it */
+  if (NULL != neighbor->my_set)
+  {
+    GNUNET_SET_destroy (neighbor->my_set);
+    neighbor->my_set = NULL;
+  }
+  neighbor->set_built = GNUNET_NO;
+  while (NULL != (route = neighbor->routes_head))
+  {
+    schedule_refresh_route (&route->target.peer);
+    destroy_route (route);
+  }
   if (NULL != neighbor->cth)
   {
     GNUNET_CORE_notify_transmit_ready_cancel (neighbor->cth);
@@ -1215,6 +1425,8 @@ handle_direct_disconnect (struct DirectNeighbor *neighbor)
     release_route (neighbor->direct_route);
     GNUNET_free (neighbor->direct_route);
     neighbor->direct_route = NULL;
+    /* maybe still reachable via other neighbors */
+    schedule_refresh_route (&neighbor->peer);
   }
 
   if (NULL != neighbor->neighbor_table_consensus)
@@ -1238,11 +1450,6 @@ handle_direct_disconnect (struct DirectNeighbor *neighbor)
     GNUNET_SET_operation_cancel (neighbor->set_op);
     neighbor->set_op = NULL;
   }
-  if (NULL != neighbor->my_set)
-  {
-    GNUNET_SET_destroy (neighbor->my_set);
-    neighbor->my_set = NULL;
-  }
   if (NULL != neighbor->listen_handle)
   {
     GNUNET_SET_listen_cancel (neighbor->listen_handle);
@@ -1318,7 +1525,6 @@ handle_ats_update (void *cls,
 				"# peers connected (1-hop)",
 				-1, GNUNET_NO);
       handle_direct_disconnect (neighbor);
-      schedule_refresh_routes ();
       return;
     }
     neighbor->distance = distance;
@@ -1375,8 +1581,8 @@ check_target_removed (void *cls,
          (current_route->next_hop == neighbor) &&
          (current_route->target.distance != new_target->distance) )
     {
-      /* need to recalculate routes due to distance change */
-      neighbor->target_removed = GNUNET_YES;
+      /* need to recalculate route due to distance change */
+      schedule_refresh_route (key);
     }
     return GNUNET_OK;
   }
@@ -1391,12 +1597,9 @@ check_target_removed (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Lost route to %s\n",
               GNUNET_i2s (&current_route->target.peer));
-  GNUNET_assert (GNUNET_YES ==
-                 GNUNET_CONTAINER_multipeermap_remove (all_routes, key, current_route));
-  send_disconnect_to_plugin (&current_route->target.peer);
-  release_route (current_route);
-  GNUNET_free (current_route);
-  neighbor->target_removed = GNUNET_YES;
+  destroy_route (current_route);
+  /* check if we got an alternative for the removed route */
+  schedule_refresh_route (key);
   return GNUNET_OK;
 }
 
@@ -1433,13 +1636,8 @@ check_target_added (void *cls,
         if (ntohl (target->distance) + 1 > DEFAULT_FISHEYE_DEPTH)
         {
           /* distance increased beyond what is allowed, kill route */
-          GNUNET_assert (GNUNET_YES ==
-                         GNUNET_CONTAINER_multipeermap_remove (all_routes,
-                                                               key,
-                                                               current_route));
-          send_disconnect_to_plugin (key);
-          release_route (current_route);
-          GNUNET_free (current_route);
+          destroy_route (current_route);
+          schedule_refresh_route (key);
         }
         else
         {
@@ -1465,7 +1663,7 @@ check_target_added (void *cls,
        direct neighbor can use this to DoS our long routes */
 
     move_route (current_route, ntohl (target->distance) + 1);
-    current_route->next_hop = neighbor;
+    set_next_hop (current_route, neighbor);
     send_distance_change_to_plugin (&target->peer,
                                     ntohl (target->distance) + 1,
                                     neighbor->network);
@@ -1477,7 +1675,7 @@ check_target_added (void *cls,
 	      GNUNET_i2s (&target->peer),
 	      (unsigned int) (ntohl (target->distance) + 1));
   current_route = GNUNET_new (struct Route);
-  current_route->next_hop = neighbor;
+  set_next_hop (current_route, neighbor);
   current_route->target.peer = target->peer;
   allocate_route (current_route, ntohl (target->distance) + 1);
   GNUNET_assert (GNUNET_YES ==
@@ -1592,18 +1790,12 @@ handle_set_union_result (void *cls,
     break;
   case GNUNET_SET_STATUS_DONE:
     /* we got all of our updates; integrate routing table! */
-    neighbor->target_removed = GNUNET_NO;
     if (NULL == neighbor->neighbor_table_consensus)
       neighbor->neighbor_table_consensus = GNUNET_CONTAINER_multipeermap_create (10, GNUNET_NO);
     if (NULL != neighbor->neighbor_table)
       GNUNET_CONTAINER_multipeermap_iterate (neighbor->neighbor_table,
                                              &check_target_removed,
                                              neighbor);
-    if (GNUNET_YES == neighbor->target_removed)
-    {
-      /* check if we got an alternative for the removed routes */
-      schedule_refresh_routes ();
-    }
     /* add targets that appeared (and check for improved routes) */
     GNUNET_CONTAINER_multipeermap_iterate (neighbor->neighbor_table_consensus,
                                            &check_target_added,
@@ -1669,21 +1861,14 @@ listen_set_union (void *cls,
     GNUNET_SET_operation_cancel (neighbor->set_op);
     neighbor->set_op = NULL;
   }
-  if (NULL != neighbor->my_set)
-  {
-    GNUNET_SET_destroy (neighbor->my_set);
-    neighbor->my_set = NULL;
-  }
-  neighbor->my_set = GNUNET_SET_create (cfg,
-					GNUNET_SET_OPERATION_UNION);
   neighbor->set_op = GNUNET_SET_accept (request,
 					GNUNET_SET_RESULT_ADDED,
 					&handle_set_union_result,
 					neighbor);
-  neighbor->consensus_insertion_offset = 0;
-  neighbor->consensus_insertion_distance = 0;
-  neighbor->consensus_elements = 0;
-  build_set (neighbor);
+  /* otherwise build_set() commits once it is done */
+  if (GNUNET_YES == neighbor->set_built)
+    GNUNET_SET_commit (neighbor->set_op,
+                       neighbor->my_set);
 }
 
 
@@ -1704,18 +1889,16 @@ initiate_set_union (void *cls,
 	      "Initiating SET union with peer `%s'\n",
 	      GNUNET_i2s (&neighbor->peer));
   neighbor->initiate_task = NULL;
-  neighbor->my_set = GNUNET_SET_create (cfg,
-					GNUNET_SET_OPERATION_UNION);
   neighbor->set_op = GNUNET_SET_prepare (&neighbor->peer,
                                          &neighbor->real_session_id,
                                          NULL,
                                          GNUNET_SET_RESULT_ADDED,
                                          &handle_set_union_result,
                                          neighbor);
-  neighbor->consensus_insertion_offset = 0;
-  neighbor->consensus_insertion_distance = 0;
-  neighbor->consensus_elements = 0;
-  build_set (neighbor);
+  /* otherwise build_set() commits once it is done */
+  if (GNUNET_YES == neighbor->set_built)
+    GNUNET_SET_commit (neighbor->set_op,
+                       neighbor->my_set);
 }
 
 
@@ -2026,10 +2209,6 @@ handle_core_disconnect (void *cls, const struct GNUNET_PeerIdentity *peer)
 			      -1, GNUNET_NO);
   }
   cleanup_neighbor (neighbor);
-
-  if (GNUNET_YES == in_shutdown)
-    return;
-  schedule_refresh_routes ();
 }
 
 
@@ -2049,11 +2228,7 @@ free_route (void *cls,
   struct Route *route = value;
 
   GNUNET_break (0);
-  GNUNET_assert (GNUNET_YES ==
-		 GNUNET_CONTAINER_multipeermap_remove (all_routes, key, value));
-  release_route (route);
-  send_disconnect_to_plugin (&route->target.peer);
-  GNUNET_free (route);
+  destroy_route (route);
   return GNUNET_YES;
 }
 
@@ -2101,7 +2276,9 @@ shutdown_task (void *cls,
   GNUNET_CONTAINER_multipeermap_iterate (all_routes,
                                          &free_route, NULL);
   GNUNET_CONTAINER_multipeermap_destroy (direct_neighbors);
+  direct_neighbors = NULL;
   GNUNET_CONTAINER_multipeermap_destroy (all_routes);
+  GNUNET_CONTAINER_multipeermap_destroy (refresh_targets);
   GNUNET_STATISTICS_destroy (stats, GNUNET_NO);
   stats = NULL;
   GNUNET_SERVER_notification_context_destroy (nc);
@@ -2216,6 +2393,7 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   cfg = c;
   direct_neighbors = GNUNET_CONTAINER_multipeermap_create (128, GNUNET_NO);
   all_routes = GNUNET_CONTAINER_multipeermap_create (65536, GNUNET_NO);
+  refresh_targets = GNUNET_CONTAINER_multipeermap_create (16, GNUNET_NO);
   core_api = GNUNET_CORE_connect (cfg, NULL,
 				  &core_init,
 				  &handle_core_connect,
@@ -30,6 +30,15 @@
 
 GNUNET_NETWORK_STRUCT_BEGIN
 
+/**
+ * Flag for `struct GNUNET_EXIT_TcpDataMessage`: the checksum in the
+ * TCP header is a partial sum over the TCP header and payload (see
+ * #GNUNET_TUN_tcp_checksum_to_partial()), so the receiver does not
+ * have to checksum the payload again.
+ */
+#define GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM 1
+
+
 /**
  * Message send via cadet to an exit daemon to initiate forwarding of
  * TCP data to a local service.
@@ -104,13 +113,16 @@ struct GNUNET_EXIT_TcpDataMessage
   struct GNUNET_MessageHeader header;
 
   /**
-   * Always 0.
+   * Flags, see GNUNET_EXIT_TCP_FLAG_*.  Other bits are always 0.
    */
-  uint32_t reserved GNUNET_PACKED;
+  uint32_t flags GNUNET_PACKED;
 
   /**
    * Skeleton of the TCP header to send.  Port numbers are to
    * be replaced and the checksum may be updated as necessary.  (The destination port number should not be changed, as it contains the desired destination port.)
+   * If #GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM is set, the checksum
+   * field contains the partial sum from
+   * #GNUNET_TUN_tcp_checksum_to_partial().
    */
   struct GNUNET_TUN_TcpHeader tcp_header;
 
@@ -78,6 +78,42 @@
  */
 #define DNS_ADVERTISEMENT_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_HOURS, 3)
 
+/**
+ * How long do we keep state for idle TCP connections?
+ */
+#define TCP_IDLE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 30)
+
+/**
+ * How long do we keep state for idle UDP "connections"?
+ */
+#define UDP_IDLE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 2)
+
+/**
+ * How long do we keep state for idle ICMP "connections"?
+ */
+#define ICMP_IDLE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+/**
+ * Granularity of the expiry wheel.
+ */
+#define WHEEL_TICK GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * Number of slots in the expiry wheel; states that expire further
+ * in the future than this many ticks are re-inserted when their
+ * slot comes up.
+ */
+#define WHEEL_SLOTS 1024
+
+/**
+ * How many DNS answers do we cache at most?
+ */
+#define MAX_DNS_CACHE_SIZE 4096
+
+
+
+struct PendingDnsQuery;
+
 
 /**
  * Generic logging shorthand
@@ -218,6 +254,16 @@ struct ChannelMessageQueue
  */
 struct ChannelState
 {
+  /**
+   * Next state in the same slot of the expiry wheel (TCP/UDP only).
+   */
+  struct ChannelState *next_wheel;
+
+  /**
+   * Previous state in the same slot of the expiry wheel (TCP/UDP only).
+   */
+  struct ChannelState *prev_wheel;
+
   /**
    * Cadet channel that is used for this connection.
    */
@@ -234,6 +280,16 @@ struct ChannelState
    */
   struct GNUNET_CADET_TransmitHandle *th;
 
+  /**
+   * Kept in a DLL of the DNS channels waiting for the same query.
+   */
+  struct ChannelState *next_pq;
+
+  /**
+   * Kept in a DLL of the DNS channels waiting for the same query.
+   */
+  struct ChannelState *prev_pq;
+
   /**
    * #GNUNET_NO if this is a channel for TCP/UDP,
    * #GNUNET_YES if this is a channel for DNS,
@@ -247,9 +303,20 @@ struct ChannelState
     {
 
       /**
-       * Heap node for this state in the connections_heap.
+       * When did we last see traffic for this connection?
+       */
+      struct GNUNET_TIME_Absolute last_used;
+
+      /**
+       * Slot of the expiry wheel this state is in.
        */
-      struct GNUNET_CONTAINER_HeapNode *heap_node;
+      unsigned int wheel_slot;
+
+      /**
+       * #GNUNET_YES if this state is in the connections_map and the
+       * expiry wheel (i.e. it has been fully set up).
+       */
+      int in_table;
 
       /**
        * Key this state has in the connections_map.
@@ -286,10 +353,16 @@ struct ChannelState
       char *reply;
 
       /**
-       * Socket we are using to transmit this request (must match if we receive
-       * a response).
+       * Query we are waiting for (possibly together with other
+       * channels), NULL for none.
+       */
+      struct PendingDnsQuery *pq;
+
+      /**
+       * Name in the client's query (the reply must spell it the
+       * same way), NULL if the request could not be parsed.
        */
-      struct GNUNET_DNSSTUB_RequestSocket *rs;
+      char *name;
 
       /**
        * Number of bytes in 'reply'.
@@ -301,11 +374,6 @@ struct ChannelState
        */
       uint16_t original_id;
 
-      /**
-       * DNS request ID that we used for forwarding.
-       */
-      uint16_t my_id;
-
     } dns;
 
   } specifics;
@@ -313,6 +381,70 @@ struct ChannelState
 };
 
 
+/**
+ * A DNS query we forwarded to the resolver.  Channels asking the same
+ * question while it is in flight wait for the same reply.
+ */
+struct PendingDnsQuery
+{
+
+  /**
+   * Hash of the (lower-case) name, type and class of the query.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Our request with the stub resolver.
+   */
+  struct GNUNET_DNSSTUB_RequestSocket *rs;
+
+  /**
+   * Head of DLL of channels waiting for the reply.
+   */
+  struct ChannelState *ts_head;
+
+  /**
+   * Tail of DLL of channels waiting for the reply.
+   */
+  struct ChannelState *ts_tail;
+
+  /**
+   * #GNUNET_YES if this query is in #dns_pending (and can be joined).
+   */
+  int in_map;
+
+};
+
+
+/**
+ * A DNS answer we may reuse for identical queries until it expires.
+ */
+struct DnsCacheEntry
+{
+
+  /**
+   * Hash of the (lower-case) name, type and class of the query.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * The answer.
+   */
+  struct GNUNET_DNSPARSER_Packet *packet;
+
+  /**
+   * Entry in the #dns_cache_heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * When does the first record in the answer expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+};
+
+
 /**
  * Return value from 'main'.
  */
@@ -380,9 +512,26 @@ static struct GNUNET_CADET_Handle *cadet_handle;
 static struct GNUNET_CONTAINER_MultiHashMap *connections_map;
 
 /**
- * Heap so we can quickly find "old" connections.
+ * Heads of the DLLs of connection states by the tick at which they
+ * may expire (modulo #WHEEL_SLOTS).  Traffic only updates
+ * `last_used`; the slot is corrected lazily when it comes up.
+ */
+static struct ChannelState *wheel_head[WHEEL_SLOTS];
+
+/**
+ * Tails of the DLLs of connection states by expiration tick.
+ */
+static struct ChannelState *wheel_tail[WHEEL_SLOTS];
+
+/**
+ * Current tick of the expiry wheel (modulo #WHEEL_SLOTS).
  */
-static struct GNUNET_CONTAINER_Heap *connections_heap;
+static unsigned int wheel_tick;
+
+/**
+ * Task that advances the expiry wheel.
+ */
+static struct GNUNET_SCHEDULER_Task *wheel_task;
 
 /**
  * If there are at least this many connections, old ones will be removed
@@ -400,9 +549,19 @@ static struct GNUNET_CONTAINER_MultiHashMap *udp_services;
 static struct GNUNET_CONTAINER_MultiHashMap *tcp_services;
 
 /**
- * Array of all open DNS requests from channels.
+ * Map of query hashes to `struct PendingDnsQuery`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *dns_pending;
+
+/**
+ * Map of query hashes to `struct DnsCacheEntry`.
  */
-static struct ChannelState *channels[UINT16_MAX + 1];
+static struct GNUNET_CONTAINER_MultiHashMap *dns_cache;
+
+/**
+ * Heap of `struct DnsCacheEntry`, sorted by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *dns_cache_heap;
 
 /**
  * Handle to the DNS Stub resolver.
@@ -509,33 +668,95 @@ transmit_reply_to_cadet (void *cls,
 
 
 /**
- * Callback called from DNSSTUB resolver when a resolution
- * succeeded.
+ * Remove a DNS answer from the cache and free it.
  *
- * @param cls NULL
- * @param rs the socket that received the response
- * @param dns the response itself
- * @param r number of bytes in dns
+ * @param ce cache entry to free
  */
 static void
-process_dns_result (void *cls,
-		    struct GNUNET_DNSSTUB_RequestSocket *rs,
-		    const struct GNUNET_TUN_DnsHeader *dns,
-		    size_t r)
+free_dns_cache_entry (struct DnsCacheEntry *ce)
 {
-  struct ChannelState *ts;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (dns_cache,
+                                                       &ce->key,
+                                                       ce));
+  GNUNET_CONTAINER_heap_remove_node (ce->hn);
+  GNUNET_DNSPARSER_free_packet (ce->packet);
+  GNUNET_free (ce);
+}
 
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Processing DNS result from stub resolver\n");
-  GNUNET_assert (NULL == cls);
-  /* Handle case that this is a reply to a request from a CADET DNS channel */
-  ts = channels[dns->id];
-  if ( (NULL == ts) ||
-       (ts->specifics.dns.rs != rs) )
-    return;
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Got a response from the stub resolver for DNS request received via CADET!\n");
-  channels[dns->id] = NULL;
+
+/**
+ * Remove expired answers from the cache.
+ */
+static void
+expire_dns_cache (void)
+{
+  struct DnsCacheEntry *ce;
+
+  while ( (NULL != (ce = GNUNET_CONTAINER_heap_peek (dns_cache_heap))) &&
+          (0 == GNUNET_TIME_absolute_get_remaining (ce->expiration).rel_value_us) )
+    free_dns_cache_entry (ce);
+}
+
+
+/**
+ * Compute the cache key for a query.
+ *
+ * @param q query to hash
+ * @param key set to the key
+ */
+static void
+get_dns_cache_key (const struct GNUNET_DNSPARSER_Query *q,
+                   struct GNUNET_HashCode *key)
+{
+  char buf[GNUNET_DNSPARSER_MAX_NAME_LENGTH + 1 + 2 * sizeof (uint16_t)];
+  uint16_t nbo;
+  size_t nlen;
+  size_t i;
+
+  nlen = strlen (q->name);
+  if (nlen > GNUNET_DNSPARSER_MAX_NAME_LENGTH)
+    nlen = GNUNET_DNSPARSER_MAX_NAME_LENGTH;
+  /* DNS names compare case-insensitively in ASCII only (RFC 4343) */
+  for (i=0;i<nlen;i++)
+    buf[i] = tolower ((unsigned char) q->name[i]);
+  buf[nlen] = '\0';
+  nbo = htons (q->type);
+  memcpy (&buf[nlen + 1], &nbo, sizeof (nbo));
+  nbo = htons (q->dns_traffic_class);
+  memcpy (&buf[nlen + 1 + sizeof (nbo)], &nbo, sizeof (nbo));
+  GNUNET_CRYPTO_hash (buf,
+                      nlen + 1 + 2 * sizeof (uint16_t),
+                      key);
+}
+
+
+/**
+ * Set the reply for a DNS channel to @a packet, with the question
+ * spelled as in the channel's query, and transmit it.
+ *
+ * @param ts channel to reply on
+ * @param packet the answer
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a packet
+ *         could not be packed
+ */
+static int
+reply_with_packet (struct ChannelState *ts,
+                   struct GNUNET_DNSPARSER_Packet *packet);
+
+
+/**
+ * Set the reply for a DNS channel and transmit it.
+ *
+ * @param ts channel to reply on
+ * @param dns the reply
+ * @param r number of bytes in @a dns
+ */
+static void
+send_dns_reply (struct ChannelState *ts,
+                const void *dns,
+                size_t r)
+{
   GNUNET_free_non_null (ts->specifics.dns.reply);
   ts->specifics.dns.reply = GNUNET_malloc (r);
   ts->specifics.dns.reply_length = r;
@@ -551,6 +772,203 @@ process_dns_result (void *cls,
 }
 
 
+static int
+reply_with_packet (struct ChannelState *ts,
+                   struct GNUNET_DNSPARSER_Packet *packet)
+{
+  char buf[UINT16_MAX];
+  char *name;
+  size_t buf_len;
+  int ret;
+
+  /* the ID is replaced in #transmit_reply_to_cadet() */
+  name = packet->queries[0].name;
+  packet->queries[0].name = ts->specifics.dns.name;
+  ret = GNUNET_DNSPARSER_pack_to_buffer (packet,
+                                         buf,
+                                         sizeof (buf),
+                                         &buf_len);
+  packet->queries[0].name = name;
+  if (GNUNET_OK != ret)
+    return GNUNET_SYSERR;
+  send_dns_reply (ts, buf, buf_len);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Try to answer a DNS query from the cache.
+ *
+ * @param ts channel that sent the query
+ * @param key cache key of the query
+ * @return #GNUNET_YES if the query was answered
+ */
+static int
+answer_from_dns_cache (struct ChannelState *ts,
+                       const struct GNUNET_HashCode *key)
+{
+  struct DnsCacheEntry *ce;
+
+  expire_dns_cache ();
+  ce = GNUNET_CONTAINER_multihashmap_get (dns_cache, key);
+  if (NULL == ce)
+    return GNUNET_NO;
+  /* the record expiration times make the TTLs count down */
+  if (GNUNET_OK != reply_with_packet (ts, ce->packet))
+  {
+    GNUNET_break (0);
+    free_dns_cache_entry (ce);
+    return GNUNET_NO;
+  }
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# DNS requests answered from cache"),
+                            1, GNUNET_NO);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Remember a DNS answer if it may be cached.
+ *
+ * @param key cache key of the query
+ * @param p the answer, ownership passes to the cache if it was cached
+ * @return #GNUNET_YES if @a p is now owned by the cache
+ */
+static int
+cache_dns_answer (const struct GNUNET_HashCode *key,
+                  struct GNUNET_DNSPARSER_Packet *p)
+{
+  struct GNUNET_TIME_Absolute expiration;
+  struct DnsCacheEntry *ce;
+  unsigned int i;
+
+  if ( (1 != p->num_queries) ||
+       (0 == p->num_answers) ||
+       (1 == p->flags.message_truncated) ||
+       (GNUNET_TUN_DNS_RETURN_CODE_NO_ERROR != p->flags.return_code) )
+    return GNUNET_NO;
+  expiration = GNUNET_TIME_UNIT_FOREVER_ABS;
+  for (i=0;i<p->num_answers;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->answers[i].expiration_time);
+  for (i=0;i<p->num_authority_records;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->authority_records[i].expiration_time);
+  for (i=0;i<p->num_additional_records;i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           p->additional_records[i].expiration_time);
+  if (0 == GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us / 1000LL / 1000LL)
+    return GNUNET_NO; /* TTL of zero, must not be cached */
+  ce = GNUNET_CONTAINER_multihashmap_get (dns_cache, key);
+  if (NULL != ce)
+    free_dns_cache_entry (ce);
+  expire_dns_cache ();
+  if (MAX_DNS_CACHE_SIZE <= GNUNET_CONTAINER_multihashmap_size (dns_cache))
+    free_dns_cache_entry (GNUNET_CONTAINER_heap_peek (dns_cache_heap));
+  ce = GNUNET_new (struct DnsCacheEntry);
+  ce->key = *key;
+  ce->packet = p;
+  ce->expiration = expiration;
+  ce->hn = GNUNET_CONTAINER_heap_insert (dns_cache_heap,
+                                         ce,
+                                         expiration.abs_value_us);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (dns_cache,
+                                                    key,
+                                                    ce,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return GNUNET_YES;
+}
+
+
+/**
+ * Stop waiting for the DNS query of a channel.  Cancels the query
+ * if no other channel waits for it.
+ *
+ * @param ts channel to detach
+ */
+static void
+detach_dns_query (struct ChannelState *ts)
+{
+  struct PendingDnsQuery *pq = ts->specifics.dns.pq;
+
+  if (NULL == pq)
+    return;
+  GNUNET_CONTAINER_MDLL_remove (pq,
+                                pq->ts_head,
+                                pq->ts_tail,
+                                ts);
+  ts->specifics.dns.pq = NULL;
+  if (NULL != pq->ts_head)
+    return;
+  GNUNET_DNSSTUB_resolve_cancel (pq->rs);
+  if (GNUNET_YES == pq->in_map)
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (dns_pending,
+                                                         &pq->key,
+                                                         pq));
+  GNUNET_free (pq);
+}
+
+
+/**
+ * Callback called from DNSSTUB resolver when a resolution
+ * succeeded.
+ *
+ * @param cls the `struct PendingDnsQuery`
+ * @param rs the socket that received the response
+ * @param dns the response itself
+ * @param r number of bytes in dns
+ */
+static void
+process_dns_result (void *cls,
+		    struct GNUNET_DNSSTUB_RequestSocket *rs,
+		    const struct GNUNET_TUN_DnsHeader *dns,
+		    size_t r)
+{
+  struct PendingDnsQuery *pq = cls;
+  struct GNUNET_DNSPARSER_Packet *p;
+  struct ChannelState *ts;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Processing DNS result from stub resolver\n");
+  if (GNUNET_YES == pq->in_map)
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (dns_pending,
+                                                         &pq->key,
+                                                         pq));
+  p = NULL;
+  if (GNUNET_YES == pq->in_map)
+    p = GNUNET_DNSPARSER_parse ((const char *) dns, r);
+  if ( (NULL != p) &&
+       (1 != p->num_queries) )
+  {
+    GNUNET_DNSPARSER_free_packet (p);
+    p = NULL;
+  }
+  while (NULL != (ts = pq->ts_head))
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Got a response from the stub resolver for DNS request received via CADET!\n");
+    GNUNET_CONTAINER_MDLL_remove (pq,
+                                  pq->ts_head,
+                                  pq->ts_tail,
+                                  ts);
+    ts->specifics.dns.pq = NULL;
+    /* echo the spelling of the channel's question */
+    if ( (NULL == p) ||
+         (0 == strcmp (p->queries[0].name,
+                       ts->specifics.dns.name)) ||
+         (GNUNET_OK != reply_with_packet (ts, p)) )
+      send_dns_reply (ts, dns, r);
+  }
+  if ( (NULL != p) &&
+       (GNUNET_YES != cache_dns_answer (&pq->key, p)) )
+    GNUNET_DNSPARSER_free_packet (p);
+  GNUNET_free (pq);
+}
+
+
 /**
  * Process a request via cadet to perform a DNS query.
  *
@@ -570,10 +988,11 @@ receive_dns_request (void *cls GNUNET_UNUSED,
 {
   struct ChannelState *ts = *channel_ctx;
   const struct GNUNET_TUN_DnsHeader *dns;
+  struct GNUNET_DNSPARSER_Packet *p;
+  struct PendingDnsQuery *pq;
+  struct GNUNET_HashCode key;
   size_t mlen = ntohs (message->size);
   size_t dlen = mlen - sizeof (struct GNUNET_MessageHeader);
-  char buf[dlen] GNUNET_ALIGN;
-  struct GNUNET_TUN_DnsHeader *dout;
 
   if (NULL == dnsstub)
   {
@@ -596,21 +1015,69 @@ receive_dns_request (void *cls GNUNET_UNUSED,
     return GNUNET_SYSERR;
   }
   dns = (const struct GNUNET_TUN_DnsHeader *) &message[1];
+  detach_dns_query (ts);
+  GNUNET_free_non_null (ts->specifics.dns.name);
+  ts->specifics.dns.name = NULL;
   ts->specifics.dns.original_id = dns->id;
-  if (channels[ts->specifics.dns.my_id] == ts)
-    channels[ts->specifics.dns.my_id] = NULL;
-  ts->specifics.dns.my_id = (uint16_t) GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-						   UINT16_MAX + 1);
-  channels[ts->specifics.dns.my_id] = ts;
-  memcpy (buf, dns, dlen);
-  dout = (struct GNUNET_TUN_DnsHeader *) buf;
-  dout->id = ts->specifics.dns.my_id;
-  ts->specifics.dns.rs = GNUNET_DNSSTUB_resolve2 (dnsstub,
-						  buf, dlen,
-						  &process_dns_result,
-						  NULL);
-  if (NULL == ts->specifics.dns.rs)
+  p = GNUNET_DNSPARSER_parse ((const char *) dns, dlen);
+  if ( (NULL != p) &&
+       (1 == p->num_queries) &&
+       (0 == p->flags.query_or_response) )
+  {
+    ts->specifics.dns.name = GNUNET_strdup (p->queries[0].name);
+    get_dns_cache_key (&p->queries[0], &key);
+    GNUNET_DNSPARSER_free_packet (p);
+    if (GNUNET_YES == answer_from_dns_cache (ts, &key))
+    {
+      GNUNET_CADET_receive_done (channel);
+      return GNUNET_OK;
+    }
+    pq = GNUNET_CONTAINER_multihashmap_get (dns_pending, &key);
+    if (NULL != pq)
+    {
+      GNUNET_STATISTICS_update (stats,
+                                gettext_noop ("# DNS requests coalesced"),
+                                1, GNUNET_NO);
+      ts->specifics.dns.pq = pq;
+      GNUNET_CONTAINER_MDLL_insert_tail (pq,
+                                         pq->ts_head,
+                                         pq->ts_tail,
+                                         ts);
+      GNUNET_CADET_receive_done (channel);
+      return GNUNET_OK;
+    }
+  }
+  else if (NULL != p)
+  {
+    GNUNET_DNSPARSER_free_packet (p);
+    p = NULL;
+  }
+  pq = GNUNET_new (struct PendingDnsQuery);
+  pq->rs = GNUNET_DNSSTUB_resolve2 (dnsstub,
+                                    dns, dlen,
+                                    &process_dns_result,
+                                    pq);
+  if (NULL == pq->rs)
+  {
+    GNUNET_free (pq);
     return GNUNET_SYSERR;
+  }
+  if (NULL != ts->specifics.dns.name)
+  {
+    /* only parsed queries can be joined (and cached) */
+    pq->key = key;
+    pq->in_map = GNUNET_YES;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (dns_pending,
+                                                      &pq->key,
+                                                      pq,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  ts->specifics.dns.pq = pq;
+  GNUNET_CONTAINER_MDLL_insert (pq,
+                                pq->ts_head,
+                                pq->ts_tail,
+                                ts);
   GNUNET_CADET_receive_done (channel);
   return GNUNET_OK;
 }
@@ -618,7 +1085,9 @@ receive_dns_request (void *cls GNUNET_UNUSED,
 
 /**
  * Given IP information about a connection, calculate the respective
- * hash we would use for the 'connections_map'.
+ * hash we would use for the 'connections_map'.  The key contains
+ * the complete 5-tuple (so it is unique), preceded by a mix of its
+ * bits, which the hashmap uses to pick the slot.
  *
  * @param hash resulting hash
  * @param ri information about the connection
@@ -627,12 +1096,12 @@ static void
 hash_redirect_info (struct GNUNET_HashCode *hash,
 		    const struct RedirectInformation *ri)
 {
+  const unsigned char *pos;
   char *off;
+  uint32_t mix;
 
   memset (hash, 0, sizeof (struct GNUNET_HashCode));
-  /* the GNUnet hashmap only uses the first sizeof(unsigned int) of the hash,
-     so we put the IP address in there (and hope for few collisions) */
-  off = (char*) hash;
+  off = (char*) &hash->bits[1];
   switch (ri->remote_address.af)
   {
   case AF_INET:
@@ -641,7 +1110,7 @@ hash_redirect_info (struct GNUNET_HashCode *hash,
     break;
   case AF_INET6:
     memcpy (off, &ri->remote_address.address.ipv6, sizeof (struct in6_addr));
-    off += sizeof (struct in_addr);
+    off += sizeof (struct in6_addr);
     break;
   default:
     GNUNET_assert (0);
@@ -656,7 +1125,7 @@ hash_redirect_info (struct GNUNET_HashCode *hash,
     break;
   case AF_INET6:
     memcpy (off, &ri->local_address.address.ipv6, sizeof (struct in6_addr));
-    off += sizeof (struct in_addr);
+    off += sizeof (struct in6_addr);
     break;
   default:
     GNUNET_assert (0);
@@ -664,7 +1133,16 @@ hash_redirect_info (struct GNUNET_HashCode *hash,
   memcpy (off, &ri->local_address.port, sizeof (uint16_t));
   off += sizeof (uint16_t);
   memcpy (off, &ri->remote_address.proto, sizeof (uint8_t));
-  /* off += sizeof (uint8_t); */
+  off += sizeof (uint8_t);
+  /* FNV-1a over the tuple, so that flows to the same remote host
+     do not all end up in the same slot */
+  mix = 2166136261U;
+  for (pos = (const unsigned char *) &hash->bits[1]; pos < (const unsigned char *) off; pos++)
+  {
+    mix ^= *pos;
+    mix *= 16777619U;
+  }
+  hash->bits[0] = mix;
 }
 
 
@@ -721,11 +1199,10 @@ get_redirect_state (int af,
   state = GNUNET_CONTAINER_multihashmap_get (connections_map, &key);
   if (NULL == state)
     return NULL;
-  /* Mark this connection as freshly used */
+  /* Mark this connection as freshly used; the expiry wheel will
+     notice when the state's slot comes up */
   if (NULL == state_key)
-    GNUNET_CONTAINER_heap_update_cost (connections_heap,
-				       state->specifics.tcp_udp.heap_node,
-				       GNUNET_TIME_absolute_get ().abs_value_us);
+    state->specifics.tcp_udp.last_used = GNUNET_TIME_absolute_get ();
   return state;
 }
 
@@ -1214,9 +1691,15 @@ tcp_from_helper (const struct GNUNET_TUN_TcpHeader *tcp,
      sender will need to lookup the correct values anyway */
   memcpy (buf, tcp, pktlen);
   mtcp = (struct GNUNET_TUN_TcpHeader *) buf;
+  /* the partial sum covers neither addresses nor ports, and spares
+     the receiver a pass over the payload */
+  mtcp->crc = GNUNET_TUN_tcp_checksum_to_partial (af,
+                                                  source_ip,
+                                                  destination_ip,
+                                                  tcp,
+                                                  (uint16_t) pktlen);
   mtcp->source_port = 0;
   mtcp->destination_port = 0;
-  mtcp->crc = 0;
 
   mlen = sizeof (struct GNUNET_EXIT_TcpDataMessage) + (pktlen - sizeof (struct GNUNET_TUN_TcpHeader));
   if (mlen >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
@@ -1231,7 +1714,7 @@ tcp_from_helper (const struct GNUNET_TUN_TcpHeader *tcp,
   tdm = (struct GNUNET_EXIT_TcpDataMessage *) &tnq[1];
   tdm->header.size = htons ((uint16_t) mlen);
   tdm->header.type = htons (GNUNET_MESSAGE_TYPE_VPN_TCP_DATA_TO_VPN);
-  tdm->reserved = htonl (0);
+  tdm->flags = htonl (GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM);
   memcpy (&tdm->tcp_header,
 	  buf,
 	  pktlen);
@@ -1488,6 +1971,181 @@ setup_fresh_address (int af,
 }
 
 
+/**
+ * How long may the given connection be idle before we drop its state?
+ *
+ * @param state connection state
+ * @return idle timeout for the protocol of the connection
+ */
+static struct GNUNET_TIME_Relative
+get_idle_timeout (const struct ChannelState *state)
+{
+  switch (state->specifics.tcp_udp.ri.remote_address.proto)
+  {
+  case IPPROTO_TCP:
+    return TCP_IDLE_TIMEOUT;
+  case IPPROTO_UDP:
+    return UDP_IDLE_TIMEOUT;
+  default:
+    return ICMP_IDLE_TIMEOUT;
+  }
+}
+
+
+/**
+ * Put the given state into the slot of the expiry wheel that
+ * corresponds to its expiration time.
+ *
+ * @param state connection state to insert
+ */
+static void
+wheel_insert (struct ChannelState *state)
+{
+  struct GNUNET_TIME_Relative remaining;
+  uint64_t ticks;
+  unsigned int slot;
+
+  remaining = GNUNET_TIME_absolute_get_remaining
+    (GNUNET_TIME_absolute_add (state->specifics.tcp_udp.last_used,
+                               get_idle_timeout (state)));
+  ticks = (remaining.rel_value_us + WHEEL_TICK.rel_value_us - 1) / WHEEL_TICK.rel_value_us;
+  if (0 == ticks)
+    ticks = 1;
+  if (ticks >= WHEEL_SLOTS)
+    ticks = WHEEL_SLOTS - 1;
+  slot = (wheel_tick + (unsigned int) ticks) % WHEEL_SLOTS;
+  state->specifics.tcp_udp.wheel_slot = slot;
+  GNUNET_CONTAINER_MDLL_insert_tail (wheel,
+                                     wheel_head[slot],
+                                     wheel_tail[slot],
+                                     state);
+}
+
+
+/**
+ * Remove the given state from the connections_map and the
+ * expiry wheel.
+ *
+ * @param state connection state to remove
+ */
+static void
+remove_state_record (struct ChannelState *state)
+{
+  unsigned int slot;
+
+  if (GNUNET_YES != state->specifics.tcp_udp.in_table)
+    return;
+  slot = state->specifics.tcp_udp.wheel_slot;
+  GNUNET_CONTAINER_MDLL_remove (wheel,
+                                wheel_head[slot],
+                                wheel_tail[slot],
+                                state);
+  GNUNET_assert (GNUNET_YES ==
+		 GNUNET_CONTAINER_multihashmap_remove (connections_map,
+						       &state->specifics.tcp_udp.state_key,
+						       state));
+  state->specifics.tcp_udp.in_table = GNUNET_NO;
+}
+
+
+/**
+ * Drop a connection: forget its state and close its channel (which
+ * frees @a state via #clean_channel()).
+ *
+ * @param state connection state to drop
+ */
+static void
+drop_state_record (struct ChannelState *state)
+{
+  remove_state_record (state);
+  if (NULL != state->th)
+  {
+    GNUNET_CADET_notify_transmit_ready_cancel (state->th);
+    state->th = NULL;
+  }
+  GNUNET_CADET_channel_destroy (state->channel);
+}
+
+
+/**
+ * Advance the expiry wheel by one tick, dropping connections that
+ * have been idle for too long and moving the others to the slot of
+ * their current expiration time.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+advance_expiry_wheel (void *cls,
+                      const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct ChannelState *state;
+  struct ChannelState *next;
+  unsigned int slot;
+
+  wheel_task = GNUNET_SCHEDULER_add_delayed (WHEEL_TICK,
+                                             &advance_expiry_wheel,
+                                             NULL);
+  wheel_tick = (wheel_tick + 1) % WHEEL_SLOTS;
+  slot = wheel_tick;
+  /* states are only re-inserted into later slots, so this terminates */
+  for (state = wheel_head[slot]; NULL != state; state = next)
+  {
+    next = state->next_wheel;
+    if (0 == GNUNET_TIME_absolute_get_remaining
+        (GNUNET_TIME_absolute_add (state->specifics.tcp_udp.last_used,
+                                   get_idle_timeout (state))).rel_value_us)
+    {
+      GNUNET_STATISTICS_update (stats,
+				gettext_noop ("# Connection states expired (idle)"),
+				1, GNUNET_NO);
+      drop_state_record (state);
+      continue;
+    }
+    GNUNET_CONTAINER_MDLL_remove (wheel,
+                                  wheel_head[slot],
+                                  wheel_tail[slot],
+                                  state);
+    wheel_insert (state);
+  }
+  GNUNET_STATISTICS_set (stats,
+			 gettext_noop ("# Connection states in use"),
+			 GNUNET_CONTAINER_multihashmap_size (connections_map),
+			 GNUNET_NO);
+}
+
+
+/**
+ * The connection table is full; drop the connection that is closest
+ * to expiring anyway.
+ *
+ * @param keep state that must not be dropped
+ */
+static void
+evict_state_record (const struct ChannelState *keep)
+{
+  struct ChannelState *state;
+  unsigned int i;
+
+  for (i = 1; i <= WHEEL_SLOTS; i++)
+  {
+    for (state = wheel_head[(wheel_tick + i) % WHEEL_SLOTS];
+         NULL != state;
+         state = state->next_wheel)
+    {
+      if (state == keep)
+        continue;
+      GNUNET_STATISTICS_update (stats,
+				gettext_noop ("# Connection states evicted (table full)"),
+				1, GNUNET_NO);
+      drop_state_record (state);
+      return;
+    }
+  }
+  GNUNET_assert (0);
+}
+
+
 /**
  * We are starting a fresh connection (TCP or UDP) and need
  * to pick a source port and IP address (within the correct
@@ -1495,7 +2153,7 @@ setup_fresh_address (int af,
  * connection / correct cadet channel.  This function generates
  * a "fresh" source IP and source port number for a connection
  * After picking a good source address, this function sets up
- * the state in the 'connections_map' and 'connections_heap'
+ * the state in the 'connections_map' and the expiry wheel
  * to allow finding the state when needed later.  The function
  * also makes sure that we remain within memory limits by
  * cleaning up 'old' states.
@@ -1505,15 +2163,14 @@ setup_fresh_address (int af,
  *              this code can determine which AF/protocol is
  *              going to be used (the 'channel' should also
  *              already be set); after calling this function,
- *              heap_node and the local_address will be
- *              also initialized (heap_node != NULL can be
+ *              in_table and the local_address will be
+ *              also initialized (in_table can be
  *              used to test if a state has been fully setup).
  */
 static void
 setup_state_record (struct ChannelState *state)
 {
   struct GNUNET_HashCode key;
-  struct ChannelState *s;
 
   /* generate fresh, unique address */
   do
@@ -1547,21 +2204,11 @@ setup_state_record (struct ChannelState *state)
 		 GNUNET_CONTAINER_multihashmap_put (connections_map,
 						    &key, state,
 						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-  state->specifics.tcp_udp.heap_node = GNUNET_CONTAINER_heap_insert (connections_heap,
-						   state,
-						   GNUNET_TIME_absolute_get ().abs_value_us);
-  while (GNUNET_CONTAINER_heap_get_size (connections_heap) > max_connections)
-  {
-    s = GNUNET_CONTAINER_heap_remove_root (connections_heap);
-    GNUNET_assert (state != s);
-    s->specifics.tcp_udp.heap_node = NULL;
-    GNUNET_CADET_channel_destroy (s->channel);
-    GNUNET_assert (GNUNET_OK ==
-		   GNUNET_CONTAINER_multihashmap_remove (connections_map,
-							 &s->specifics.tcp_udp.state_key,
-							 s));
-    GNUNET_free (s);
-  }
+  state->specifics.tcp_udp.in_table = GNUNET_YES;
+  state->specifics.tcp_udp.last_used = GNUNET_TIME_absolute_get ();
+  wheel_insert (state);
+  while (GNUNET_CONTAINER_multihashmap_size (connections_map) > max_connections)
+    evict_state_record (state);
 }
 
 
@@ -1577,6 +2224,9 @@ setup_state_record (struct ChannelState *state)
  * @param payload_length number of bytes in 'payload'
  * @param protocol IPPROTO_UDP or IPPROTO_TCP
  * @param tcp_header skeleton of the TCP header, NULL for UDP
+ * @param tcp_partial_crc partial checksum of the TCP header and payload
+ *        (see #GNUNET_TUN_tcp_checksum_to_partial()), 0 to compute
+ *        the checksum over the payload
  * @param src_address source address to use (IP and port)
  * @param dst_address destination address to use (IP and port)
  * @param pkt4 where to write the assembled packet; must
@@ -1587,6 +2237,7 @@ static void
 prepare_ipv4_packet (const void *payload, size_t payload_length,
 		     int protocol,
 		     const struct GNUNET_TUN_TcpHeader *tcp_header,
+		     uint16_t tcp_partial_crc,
 		     const struct SocketAddress *src_address,
 		     const struct SocketAddress *dst_address,
 		     struct GNUNET_TUN_IPv4Header *pkt4)
@@ -1640,10 +2291,18 @@ prepare_ipv4_packet (const void *payload, size_t payload_length,
       *pkt4_tcp = *tcp_header;
       pkt4_tcp->source_port = htons (src_address->port);
       pkt4_tcp->destination_port = htons (dst_address->port);
-      GNUNET_TUN_calculate_tcp4_checksum (pkt4,
-					  pkt4_tcp,
-					  payload,
-					  payload_length);
+      if (0 != tcp_partial_crc)
+	GNUNET_TUN_calculate_tcp_checksum_from_partial (AF_INET,
+							&pkt4->source_address,
+							&pkt4->destination_address,
+							pkt4_tcp,
+							(uint16_t) len,
+							tcp_partial_crc);
+      else
+	GNUNET_TUN_calculate_tcp4_checksum (pkt4,
+					    pkt4_tcp,
+					    payload,
+					    payload_length);
       memcpy (&pkt4_tcp[1], payload, payload_length);
     }
     break;
@@ -1665,6 +2324,9 @@ prepare_ipv4_packet (const void *payload, size_t payload_length,
  * @param payload_length number of bytes in 'payload'
  * @param protocol IPPROTO_UDP or IPPROTO_TCP
  * @param tcp_header skeleton TCP header data to send, NULL for UDP
+ * @param tcp_partial_crc partial checksum of the TCP header and payload
+ *        (see #GNUNET_TUN_tcp_checksum_to_partial()), 0 to compute
+ *        the checksum over the payload
  * @param src_address source address to use (IP and port)
  * @param dst_address destination address to use (IP and port)
  * @param pkt6 where to write the assembled packet; must
@@ -1675,6 +2337,7 @@ static void
 prepare_ipv6_packet (const void *payload, size_t payload_length,
 		     int protocol,
 		     const struct GNUNET_TUN_TcpHeader *tcp_header,
+		     uint16_t tcp_partial_crc,
 		     const struct SocketAddress *src_address,
 		     const struct SocketAddress *dst_address,
 		     struct GNUNET_TUN_IPv6Header *pkt6)
@@ -1730,10 +2393,18 @@ prepare_ipv6_packet (const void *payload, size_t payload_length,
       *pkt6_tcp = *tcp_header;
       pkt6_tcp->source_port = htons (src_address->port);
       pkt6_tcp->destination_port = htons (dst_address->port);
-      GNUNET_TUN_calculate_tcp6_checksum (pkt6,
-					  pkt6_tcp,
-					  payload,
-					  payload_length);
+      if (0 != tcp_partial_crc)
+	GNUNET_TUN_calculate_tcp_checksum_from_partial (AF_INET6,
+							&pkt6->source_address,
+							&pkt6->destination_address,
+							pkt6_tcp,
+							(uint16_t) len,
+							tcp_partial_crc);
+      else
+	GNUNET_TUN_calculate_tcp6_checksum (pkt6,
+					    pkt6_tcp,
+					    payload,
+					    payload_length);
       memcpy (&pkt6_tcp[1], payload, payload_length);
     }
     break;
@@ -1750,6 +2421,8 @@ prepare_ipv6_packet (const void *payload, size_t payload_length,
  * @param destination_address IP and port to use for the TCP packet's destination
  * @param source_address IP and port to use for the TCP packet's source
  * @param tcp_header header template to use
+ * @param tcp_partial_crc partial checksum of the TCP header and payload
+ *        (see #GNUNET_TUN_tcp_checksum_to_partial()), 0 if unknown
  * @param payload payload of the TCP packet
  * @param payload_length number of bytes in @a payload
  */
@@ -1757,6 +2430,7 @@ static void
 send_tcp_packet_via_tun (const struct SocketAddress *destination_address,
 			 const struct SocketAddress *source_address,
 			 const struct GNUNET_TUN_TcpHeader *tcp_header,
+			 uint16_t tcp_partial_crc,
 			 const void *payload, size_t payload_length)
 {
   size_t len;
@@ -1807,6 +2481,7 @@ send_tcp_packet_via_tun (const struct SocketAddress *destination_address,
 	prepare_ipv4_packet (payload, payload_length,
 			     IPPROTO_TCP,
 			     tcp_header,
+			     tcp_partial_crc,
 			     source_address,
 			     destination_address,
 			     ipv4);
@@ -1820,6 +2495,7 @@ send_tcp_packet_via_tun (const struct SocketAddress *destination_address,
 	prepare_ipv6_packet (payload, payload_length,
 			     IPPROTO_TCP,
 			     tcp_header,
+			     tcp_partial_crc,
 			     source_address,
 			     destination_address,
 			     ipv6);
@@ -1889,7 +2565,7 @@ receive_tcp_service (void *cls,
   start = (const struct GNUNET_EXIT_TcpServiceStartMessage*) message;
   pkt_len -= sizeof (struct GNUNET_EXIT_TcpServiceStartMessage);
   if ( (NULL != state->specifics.tcp_udp.serv) ||
-       (NULL != state->specifics.tcp_udp.heap_node) )
+       (GNUNET_YES == state->specifics.tcp_udp.in_table) )
   {
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
@@ -1926,6 +2602,7 @@ receive_tcp_service (void *cls,
   send_tcp_packet_via_tun (&state->specifics.tcp_udp.ri.remote_address,
 			   &state->specifics.tcp_udp.ri.local_address,
 			   &start->tcp_header,
+			   0,
 			   &start[1], pkt_len);
   GNUNET_CADET_receive_done (channel);
   return GNUNET_YES;
@@ -1985,7 +2662,7 @@ receive_tcp_remote (void *cls GNUNET_UNUSED,
   start = (const struct GNUNET_EXIT_TcpInternetStartMessage*) message;
   pkt_len -= sizeof (struct GNUNET_EXIT_TcpInternetStartMessage);
   if ( (NULL != state->specifics.tcp_udp.serv) ||
-       (NULL != state->specifics.tcp_udp.heap_node) )
+       (GNUNET_YES == state->specifics.tcp_udp.in_table) )
   {
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
@@ -2051,6 +2728,7 @@ receive_tcp_remote (void *cls GNUNET_UNUSED,
   send_tcp_packet_via_tun (&state->specifics.tcp_udp.ri.remote_address,
 			   &state->specifics.tcp_udp.ri.local_address,
 			   &start->tcp_header,
+			   0,
 			   payload, pkt_len);
   GNUNET_CADET_receive_done (channel);
   return GNUNET_YES;
@@ -2092,7 +2770,7 @@ receive_tcp_data (void *cls GNUNET_UNUSED,
   data = (const struct GNUNET_EXIT_TcpDataMessage*) message;
   pkt_len -= sizeof (struct GNUNET_EXIT_TcpDataMessage);
   if ( (NULL == state) ||
-       (NULL == state->specifics.tcp_udp.heap_node) )
+       (GNUNET_YES != state->specifics.tcp_udp.in_table) )
   {
     /* connection should have been up! */
     GNUNET_STATISTICS_update (stats,
@@ -2117,7 +2795,7 @@ receive_tcp_data (void *cls GNUNET_UNUSED,
     state->is_dns = GNUNET_NO;
   }
 
-  GNUNET_break_op (ntohl (data->reserved) == 0);
+  GNUNET_break_op (0 == (ntohl (data->flags) & ~GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM));
   {
     char buf[INET6_ADDRSTRLEN];
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -2133,6 +2811,9 @@ receive_tcp_data (void *cls GNUNET_UNUSED,
   send_tcp_packet_via_tun (&state->specifics.tcp_udp.ri.remote_address,
 			   &state->specifics.tcp_udp.ri.local_address,
 			   &data->tcp_header,
+			   (0 != (ntohl (data->flags) & GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM))
+			   ? data->tcp_header.crc
+			   : 0,
 			   &data[1], pkt_len);
   GNUNET_CADET_receive_done (channel);
   return GNUNET_YES;
@@ -2343,7 +3024,7 @@ receive_icmp_remote (void *cls,
   pkt_len -= sizeof (struct GNUNET_EXIT_IcmpInternetMessage);
 
   af = (int) ntohl (msg->af);
-  if ( (NULL != state->specifics.tcp_udp.heap_node) &&
+  if ( (GNUNET_YES == state->specifics.tcp_udp.in_table) &&
        (af != state->specifics.tcp_udp.ri.remote_address.af) )
   {
     /* other peer switched AF on this channel; not allowed */
@@ -2368,7 +3049,7 @@ receive_icmp_remote (void *cls,
     payload = &v4[1];
     pkt_len -= sizeof (struct in_addr);
     state->specifics.tcp_udp.ri.remote_address.address.ipv4 = *v4;
-    if (NULL == state->specifics.tcp_udp.heap_node)
+    if (GNUNET_YES != state->specifics.tcp_udp.in_table)
     {
       state->specifics.tcp_udp.ri.remote_address.af = af;
       state->specifics.tcp_udp.ri.remote_address.proto = IPPROTO_ICMP;
@@ -2426,7 +3107,7 @@ receive_icmp_remote (void *cls,
     payload = &v6[1];
     pkt_len -= sizeof (struct in6_addr);
     state->specifics.tcp_udp.ri.remote_address.address.ipv6 = *v6;
-    if (NULL == state->specifics.tcp_udp.heap_node)
+    if (GNUNET_YES != state->specifics.tcp_udp.in_table)
     {
       state->specifics.tcp_udp.ri.remote_address.af = af;
       state->specifics.tcp_udp.ri.remote_address.proto = IPPROTO_ICMPV6;
@@ -2803,6 +3484,7 @@ send_udp_packet_via_tun (const struct SocketAddress *destination_address,
 	prepare_ipv4_packet (payload, payload_length,
 			     IPPROTO_UDP,
 			     NULL,
+			     0,
 			     source_address,
 			     destination_address,
 			     ipv4);
@@ -2816,6 +3498,7 @@ send_udp_packet_via_tun (const struct SocketAddress *destination_address,
 	prepare_ipv6_packet (payload, payload_length,
 			     IPPROTO_UDP,
 			     NULL,
+			     0,
 			     source_address,
 			     destination_address,
 			     ipv6);
@@ -2933,7 +3616,7 @@ receive_udp_remote (void *cls,
   }
   state->specifics.tcp_udp.ri.remote_address.proto = IPPROTO_UDP;
   state->specifics.tcp_udp.ri.remote_address.port = msg->destination_port;
-  if (NULL == state->specifics.tcp_udp.heap_node)
+  if (GNUNET_YES != state->specifics.tcp_udp.in_table)
     setup_state_record (state);
   if (0 != ntohs (msg->source_port))
     state->specifics.tcp_udp.ri.local_address.port = msg->source_port;
@@ -3080,8 +3763,8 @@ clean_channel (void *cls,
   }
   if (GNUNET_YES == s->is_dns)
   {
-    if (channels[s->specifics.dns.my_id] == s)
-      channels[s->specifics.dns.my_id] = NULL;
+    detach_dns_query (s);
+    GNUNET_free_non_null (s->specifics.dns.name);
     GNUNET_free_non_null (s->specifics.dns.reply);
   }
   else
@@ -3093,15 +3776,7 @@ clean_channel (void *cls,
 				   tnq);
       GNUNET_free (tnq);
     }
-    if (NULL != s->specifics.tcp_udp.heap_node)
-    {
-      GNUNET_assert (GNUNET_YES ==
-		     GNUNET_CONTAINER_multihashmap_remove (connections_map,
-							   &s->specifics.tcp_udp.state_key,
-							   s));
-      GNUNET_CONTAINER_heap_remove_node (s->specifics.tcp_udp.heap_node);
-      s->specifics.tcp_udp.heap_node = NULL;
-    }
+    remove_state_record (s);
   }
   if (NULL != s->th)
   {
@@ -3156,6 +3831,7 @@ static void
 cleanup (void *cls,
          const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  struct DnsCacheEntry *ce;
   unsigned int i;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -3187,10 +3863,10 @@ cleanup (void *cls,
     GNUNET_CONTAINER_multihashmap_destroy (connections_map);
     connections_map = NULL;
   }
-  if (NULL != connections_heap)
+  if (NULL != wheel_task)
   {
-    GNUNET_CONTAINER_heap_destroy (connections_heap);
-    connections_heap = NULL;
+    GNUNET_SCHEDULER_cancel (wheel_task);
+    wheel_task = NULL;
   }
   if (NULL != tcp_services)
   {
@@ -3209,6 +3885,22 @@ cleanup (void *cls,
     GNUNET_DNSSTUB_stop (dnsstub);
     dnsstub = NULL;
   }
+  if (NULL != dns_cache)
+  {
+    while (NULL != (ce = GNUNET_CONTAINER_heap_peek (dns_cache_heap)))
+      free_dns_cache_entry (ce);
+    GNUNET_CONTAINER_multihashmap_destroy (dns_cache);
+    dns_cache = NULL;
+    GNUNET_CONTAINER_heap_destroy (dns_cache_heap);
+    dns_cache_heap = NULL;
+  }
+  if (NULL != dns_pending)
+  {
+    /* all channels (and thus their queries) are gone by now */
+    GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (dns_pending));
+    GNUNET_CONTAINER_multihashmap_destroy (dns_pending);
+    dns_pending = NULL;
+  }
   if (NULL != peer_key)
   {
     GNUNET_free (peer_key);
@@ -3629,6 +4321,10 @@ run (void *cls,
   }
   if (NULL != dns_exit)
   {
+    dnsstub = GNUNET_DNSSTUB_start (dns_exit);
+    dns_pending = GNUNET_CONTAINER_multihashmap_create (256, GNUNET_NO);
+    dns_cache = GNUNET_CONTAINER_multihashmap_create (256, GNUNET_NO);
+    dns_cache_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
     dht = GNUNET_DHT_connect (cfg, 1);
     peer_key = GNUNET_CRYPTO_eddsa_key_create_from_configuration (cfg);
     GNUNET_CRYPTO_eddsa_key_get_public (peer_key,
@@ -3755,8 +4451,15 @@ run (void *cls,
   tcp_services = GNUNET_CONTAINER_multihashmap_create (65536, GNUNET_NO);
   GNUNET_CONFIGURATION_iterate_sections (cfg, &read_service_conf, NULL);
 
-  connections_map = GNUNET_CONTAINER_multihashmap_create (65536, GNUNET_NO);
-  connections_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  /* size the table for the connection limit up front, so that it
+     does not need to grow under load */
+  connections_map
+    = GNUNET_CONTAINER_multihashmap_create ((unsigned int) GNUNET_MIN (max_connections + 1,
+                                                                       4 * 1024 * 1024),
+                                            GNUNET_NO);
+  wheel_task = GNUNET_SCHEDULER_add_delayed (WHEEL_TICK,
+                                             &advance_expiry_wheel,
+                                             NULL);
   if (0 == app_idx)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
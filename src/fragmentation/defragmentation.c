@@ -26,6 +26,16 @@
 #include "gnunet_fragmentation_lib.h"
 #include "fragmentation.h"
 
+/**
+ * Acknowledge after at most this many new fragments of a message.
+ */
+#define ACK_EVERY 2
+
+/**
+ * Never delay an acknowledgement for longer than this.
+ */
+#define MAX_ACK_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 25)
+
 /**
  * Timestamps for fragments.
  */
@@ -119,6 +129,11 @@ struct MessageContext
    */
   unsigned int frag_times_write_offset;
 
+  /**
+   * Number of new fragments we received since the last ACK.
+   */
+  unsigned int unacked;
+
   /**
    * Total size of the message that we are assembling.
    */
@@ -278,6 +293,7 @@ send_ack (void *cls,
                             1,
                             GNUNET_NO);
   mc->last_duplicate = GNUNET_NO; /* clear flag */
+  mc->unacked = 0;
   dc->ackp (dc->cls,
             mc->fragment_id,
             &fa.header);
@@ -531,6 +547,7 @@ GNUNET_DEFRAGMENT_process_fragment (struct GNUNET_DEFRAGMENT_Context *dc,
     mc->frag_times[mc->frag_times_write_offset].time = now;
     mc->frag_times[mc->frag_times_write_offset].bit = bit;
     mc->frag_times_write_offset++;
+    mc->unacked++;
     duplicate = GNUNET_NO;
   }
   else
@@ -568,6 +585,8 @@ GNUNET_DEFRAGMENT_process_fragment (struct GNUNET_DEFRAGMENT_Context *dc,
   }
   delay = GNUNET_TIME_relative_multiply (dc->latency,
                                          bc + 1);
+  delay = GNUNET_TIME_relative_min (delay,
+                                    MAX_ACK_DELAY);
   if ( (last + fid == num_fragments) ||
        (0 == mc->bits) ||
        (GNUNET_YES == duplicate) )
@@ -576,6 +595,15 @@ GNUNET_DEFRAGMENT_process_fragment (struct GNUNET_DEFRAGMENT_Context *dc,
        linear sequence; ACK now! */
     delay = GNUNET_TIME_UNIT_ZERO;
   }
+  if ( (mc->unacked >= ACK_EVERY) ||
+       ( (GNUNET_NO == duplicate) &&
+         (0 != (mc->bits & ((1LL << bit) - 1))) ) )
+  {
+    /* enough fragments for an ACK, or an earlier fragment is still
+       missing (likely lost); ACK now so that a sender with
+       congestion control can keep its window moving */
+    delay = GNUNET_TIME_UNIT_ZERO;
+  }
   if (NULL != mc->ack_task)
     GNUNET_SCHEDULER_cancel (mc->ack_task);
   mc->ack_task = GNUNET_SCHEDULER_add_delayed (delay,
@@ -33,17 +33,159 @@
  */
 #define MIN_ACK_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 1)
 
+/**
+ * Initial congestion window (in fragments).
+ */
+#define CC_INITIAL_WINDOW 4
+
+/**
+ * Smallest congestion window we reduce to after a loss.
+ */
+#define CC_MIN_WINDOW 2
+
+/**
+ * Multiplicative decrease factor of CUBIC.
+ */
+#define CC_CUBIC_BETA 0.7
+
+/**
+ * Scaling constant of the CUBIC window growth function (fragments
+ * per second cubed).
+ */
+#define CC_CUBIC_C 0.4
+
+/**
+ * Retransmission timeout before we have an RTT sample.
+ */
+#define CC_INITIAL_RTO GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * Smallest retransmission timeout we use.
+ */
+#define CC_MIN_RTO GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
+/**
+ * Largest retransmission timeout we use.
+ */
+#define CC_MAX_RTO GNUNET_TIME_UNIT_MINUTES
+
+
+/**
+ * Congestion control state shared by all fragmentation contexts
+ * for the same peer.
+ */
+struct GNUNET_FRAGMENT_Congestion
+{
+  /**
+   * Head of DLL of contexts waiting for room in the window.
+   */
+  struct GNUNET_FRAGMENT_Context *wait_head;
+
+  /**
+   * Tail of DLL of contexts waiting for room in the window.
+   */
+  struct GNUNET_FRAGMENT_Context *wait_tail;
+
+  /**
+   * Smoothed round-trip time, zero before the first sample.
+   */
+  struct GNUNET_TIME_Relative srtt;
+
+  /**
+   * Round-trip time variation.
+   */
+  struct GNUNET_TIME_Relative rttvar;
+
+  /**
+   * Retransmission timeout.
+   */
+  struct GNUNET_TIME_Relative rto;
+
+  /**
+   * When did we last reduce the window?  Losses of fragments sent
+   * before this time belong to the same congestion event.
+   */
+  struct GNUNET_TIME_Absolute recovery_start;
+
+  /**
+   * Start of the current CUBIC epoch, zero if none started yet.
+   */
+  struct GNUNET_TIME_Absolute epoch_start;
+
+  /**
+   * Congestion window, in fragments.
+   */
+  double cwnd;
+
+  /**
+   * Slow start threshold, in fragments.
+   */
+  double ssthresh;
+
+  /**
+   * Window before the last reduction.
+   */
+  double w_max;
+
+  /**
+   * Time (in seconds) CUBIC needs to grow back to @e w_max.
+   */
+  double k;
+
+  /**
+   * Window Reno would have in the current epoch (CUBIC's
+   * TCP-friendly region, which dominates at small RTTs).
+   */
+  double w_est;
+
+  /**
+   * Total number of fragments transmitted.
+   */
+  uint64_t sent;
+
+  /**
+   * Number of fragments transmitted again.
+   */
+  uint64_t retransmitted;
+
+  /**
+   * Number of fragments considered lost.
+   */
+  uint64_t lost;
+
+  /**
+   * Number of fragments currently in flight.
+   */
+  unsigned int in_flight;
+};
+
 
 /**
  * Fragmentation context.
  */
 struct GNUNET_FRAGMENT_Context
 {
+  /**
+   * This is a DLL (of contexts waiting for the congestion window).
+   */
+  struct GNUNET_FRAGMENT_Context *next;
+
+  /**
+   * This is a DLL (of contexts waiting for the congestion window).
+   */
+  struct GNUNET_FRAGMENT_Context *prev;
+
   /**
    * Statistics to use.
    */
   struct GNUNET_STATISTICS_Handle *stats;
 
+  /**
+   * Congestion control to use, NULL if we pace based on
+   * @e msg_delay and @e ack_delay.
+   */
+  struct GNUNET_FRAGMENT_Congestion *cc;
+
   /**
    * Tracker for flow control.
    */
@@ -95,6 +237,22 @@ struct GNUNET_FRAGMENT_Context
    */
   uint64_t acks_mask;
 
+  /**
+   * Bitfield, set to 1 for each fragment in flight (with @e cc).
+   */
+  uint64_t in_flight;
+
+  /**
+   * Bitfield, set to 1 for each fragment transmitted more than once
+   * (with @e cc; their ACKs are not used to measure the RTT).
+   */
+  uint64_t retransmitted;
+
+  /**
+   * Time each fragment was last transmitted (with @e cc).
+   */
+  struct GNUNET_TIME_Absolute sent_at[64];
+
   /**
    * Task performing work for the fragmenter.
    */
@@ -110,6 +268,12 @@ struct GNUNET_FRAGMENT_Context
    */
   unsigned int next_transmission;
 
+  /**
+   * Priority for room in the congestion window, see
+   * #GNUNET_FRAGMENT_context_set_priority().
+   */
+  unsigned int priority;
+
   /**
    * How many rounds of transmission have we completed so far?
    */
@@ -130,6 +294,12 @@ struct GNUNET_FRAGMENT_Context
    */
   int8_t wack;
 
+  /**
+   * #GNUNET_YES if we are in the DLL of @e cc waiting for room in
+   * the congestion window.
+   */
+  int8_t waiting;
+
   /**
    * Target fragment size.
    */
@@ -163,6 +333,504 @@ GNUNET_FRAGMENT_print_ack (const struct GNUNET_MessageHeader *ack)
 }
 
 
+/**
+ * Compute the size of a fragment.
+ *
+ * @param fc fragmentation context
+ * @param bit number of the fragment
+ * @return size of the fragment, including the #FragmentHeader
+ */
+static size_t
+fragment_size (const struct GNUNET_FRAGMENT_Context *fc,
+               unsigned int bit)
+{
+  size_t size;
+
+  size = ntohs (fc->msg->size);
+  if (bit == size / (fc->mtu - sizeof (struct FragmentHeader)))
+    return (size % (fc->mtu - sizeof (struct FragmentHeader))) +
+      sizeof (struct FragmentHeader);
+  return fc->mtu;
+}
+
+
+/**
+ * Assemble a fragment message.
+ *
+ * @param fc fragmentation context
+ * @param bit number of the fragment
+ * @param fsize size of the fragment, from fragment_size()
+ * @param[out] fh where to write the fragment (@a fsize bytes)
+ */
+static void
+assemble_fragment (const struct GNUNET_FRAGMENT_Context *fc,
+                   unsigned int bit,
+                   size_t fsize,
+                   struct FragmentHeader *fh)
+{
+  const char *mbuf;
+
+  mbuf = (const char *) &fc[1];
+  fh->header.size = htons (fsize);
+  fh->header.type = htons (GNUNET_MESSAGE_TYPE_FRAGMENT);
+  fh->fragment_id = htonl (fc->fragment_id);
+  fh->total_size = fc->msg->size;       /* already in big-endian */
+  fh->offset = htons ((fc->mtu - sizeof (struct FragmentHeader)) * bit);
+  memcpy (&fh[1], &mbuf[bit * (fc->mtu - sizeof (struct FragmentHeader))],
+          fsize - sizeof (struct FragmentHeader));
+}
+
+
+/**
+ * Count the bits that are set.
+ *
+ * @param v bitfield
+ * @return number of bits set in @a v
+ */
+static unsigned int
+count_bits (uint64_t v)
+{
+  unsigned int n;
+
+  for (n = 0; 0 != v; n++)
+    v &= v - 1;
+  return n;
+}
+
+
+/**
+ * Update the RTT estimate of a congestion controller (RFC 6298).
+ *
+ * @param cc congestion controller
+ * @param rtt new sample
+ */
+static void
+cc_rtt_sample (struct GNUNET_FRAGMENT_Congestion *cc,
+               struct GNUNET_TIME_Relative rtt)
+{
+  uint64_t delta;
+
+  if (0 == cc->srtt.rel_value_us)
+  {
+    cc->srtt = rtt;
+    cc->rttvar.rel_value_us = rtt.rel_value_us / 2;
+  }
+  else
+  {
+    delta = (cc->srtt.rel_value_us > rtt.rel_value_us)
+      ? cc->srtt.rel_value_us - rtt.rel_value_us
+      : rtt.rel_value_us - cc->srtt.rel_value_us;
+    cc->rttvar.rel_value_us = (3 * cc->rttvar.rel_value_us + delta) / 4;
+    cc->srtt.rel_value_us = (7 * cc->srtt.rel_value_us + rtt.rel_value_us) / 8;
+  }
+  cc->rto.rel_value_us = cc->srtt.rel_value_us + 4 * cc->rttvar.rel_value_us;
+  cc->rto = GNUNET_TIME_relative_max (cc->rto,
+                                      CC_MIN_RTO);
+  cc->rto = GNUNET_TIME_relative_min (cc->rto,
+                                      CC_MAX_RTO);
+}
+
+
+/**
+ * Grow the congestion window for acknowledged fragments, using slow
+ * start below the threshold and the CUBIC growth function above.
+ *
+ * @param cc congestion controller
+ * @param acked number of fragments that were acknowledged
+ */
+static void
+cc_on_ack (struct GNUNET_FRAGMENT_Congestion *cc,
+           unsigned int acked)
+{
+  struct GNUNET_TIME_Absolute now;
+  double t;
+  double target;
+
+  if (0 == acked)
+    return;
+  now = GNUNET_TIME_absolute_get ();
+  while (acked-- > 0)
+  {
+    if (cc->cwnd < cc->ssthresh)
+    {
+      cc->cwnd += 1.0;
+      continue;
+    }
+    if (0 == cc->epoch_start.abs_value_us)
+    {
+      cc->epoch_start = now;
+      cc->w_est = cc->cwnd;
+      if (cc->cwnd < cc->w_max)
+        cc->k = cbrt ((cc->w_max - cc->cwnd) / CC_CUBIC_C);
+      else
+      {
+        cc->k = 0.0;
+        cc->w_max = cc->cwnd;
+      }
+    }
+    t = (GNUNET_TIME_absolute_get_difference (cc->epoch_start,
+                                              now).rel_value_us +
+         cc->srtt.rel_value_us) / 1000000.0;
+    target = cc->w_max + CC_CUBIC_C * (t - cc->k) * (t - cc->k) * (t - cc->k);
+    cc->w_est += 3.0 * (1.0 - CC_CUBIC_BETA) / (1.0 + CC_CUBIC_BETA) / cc->cwnd;
+    target = GNUNET_MAX (target,
+                         cc->w_est);
+    if (target > cc->cwnd)
+      cc->cwnd += (target - cc->cwnd) / cc->cwnd;
+    else
+      cc->cwnd += 0.01 / cc->cwnd;
+  }
+}
+
+
+/**
+ * Reduce the congestion window after fragments were lost (once per
+ * congestion event).
+ *
+ * @param cc congestion controller
+ * @param sent_at latest transmission time of the lost fragments
+ */
+static void
+cc_on_loss (struct GNUNET_FRAGMENT_Congestion *cc,
+            struct GNUNET_TIME_Absolute sent_at)
+{
+  if (sent_at.abs_value_us < cc->recovery_start.abs_value_us)
+    return; /* sent before we reacted to the last loss */
+  cc->recovery_start = GNUNET_TIME_absolute_get ();
+  cc->w_max = cc->cwnd;
+  cc->cwnd = GNUNET_MAX (cc->cwnd * CC_CUBIC_BETA,
+                         CC_MIN_WINDOW);
+  cc->ssthresh = cc->cwnd;
+  cc->epoch_start = GNUNET_TIME_UNIT_ZERO_ABS;
+}
+
+
+/**
+ * Collapse the congestion window after a retransmission timeout
+ * (once per congestion event).
+ *
+ * @param cc congestion controller
+ * @param sent_at latest transmission time of the timed out fragments
+ */
+static void
+cc_on_timeout (struct GNUNET_FRAGMENT_Congestion *cc,
+               struct GNUNET_TIME_Absolute sent_at)
+{
+  if (sent_at.abs_value_us < cc->recovery_start.abs_value_us)
+    return; /* sent before we reacted to the last loss */
+  cc->recovery_start = GNUNET_TIME_absolute_get ();
+  cc->w_max = cc->cwnd;
+  cc->ssthresh = GNUNET_MAX (cc->cwnd * CC_CUBIC_BETA,
+                             CC_MIN_WINDOW);
+  cc->cwnd = 1.0;
+  cc->epoch_start = GNUNET_TIME_UNIT_ZERO_ABS;
+  cc->rto = GNUNET_TIME_relative_min (GNUNET_TIME_relative_multiply (cc->rto,
+                                                                     2),
+                                      CC_MAX_RTO);
+}
+
+
+/**
+ * Fragments are no longer in flight, release their room in the
+ * congestion window.
+ *
+ * @param fc fragmentation context
+ * @param bits fragments to release
+ */
+static void
+cc_release (struct GNUNET_FRAGMENT_Context *fc,
+            uint64_t bits)
+{
+  bits &= fc->in_flight;
+  fc->in_flight &= ~bits;
+  fc->cc->in_flight -= count_bits (bits);
+}
+
+
+/**
+ * Start waiting for room in the congestion window, behind all
+ * contexts with the same or a higher priority.
+ *
+ * @param fc fragmentation context
+ */
+static void
+cc_start_waiting (struct GNUNET_FRAGMENT_Context *fc)
+{
+  struct GNUNET_FRAGMENT_Context *pos;
+
+  if (GNUNET_YES == fc->waiting)
+    return;
+  for (pos = fc->cc->wait_tail; NULL != pos; pos = pos->prev)
+    if (pos->priority >= fc->priority)
+      break;
+  GNUNET_CONTAINER_DLL_insert_after (fc->cc->wait_head,
+                                     fc->cc->wait_tail,
+                                     pos,
+                                     fc);
+  fc->waiting = GNUNET_YES;
+}
+
+
+/**
+ * Stop waiting for room in the congestion window.
+ *
+ * @param fc fragmentation context
+ */
+static void
+cc_stop_waiting (struct GNUNET_FRAGMENT_Context *fc)
+{
+  if (GNUNET_NO == fc->waiting)
+    return;
+  GNUNET_CONTAINER_DLL_remove (fc->cc->wait_head,
+                               fc->cc->wait_tail,
+                               fc);
+  fc->waiting = GNUNET_NO;
+}
+
+
+/**
+ * Transmit the next fragment to the other peer.
+ *
+ * @param cls the `struct GNUNET_FRAGMENT_Context`
+ * @param tc scheduler context
+ */
+static void
+transmit_next (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Let contexts waiting for room in the congestion window transmit,
+ * if there is room now.
+ *
+ * @param cc congestion controller
+ */
+static void
+cc_wake (struct GNUNET_FRAGMENT_Congestion *cc)
+{
+  struct GNUNET_FRAGMENT_Context *fc;
+  unsigned int room;
+
+  if (cc->cwnd <= cc->in_flight)
+    return;
+  room = (unsigned int) cc->cwnd - cc->in_flight;
+  while ( (room > 0) &&
+          (NULL != (fc = cc->wait_head)) )
+  {
+    cc_stop_waiting (fc);
+    room--;
+    if (NULL != fc->task)
+      GNUNET_SCHEDULER_cancel (fc->task);
+    fc->task = GNUNET_SCHEDULER_add_now (&transmit_next, fc);
+  }
+}
+
+
+/**
+ * Schedule the retransmission timeout for the fragments of @a fc
+ * in flight.
+ *
+ * @param fc fragmentation context
+ */
+static void
+cc_arm_timer (struct GNUNET_FRAGMENT_Context *fc)
+{
+  struct GNUNET_TIME_Absolute earliest;
+  unsigned int bit;
+
+  earliest = GNUNET_TIME_UNIT_FOREVER_ABS;
+  for (bit = 0; bit < 64; bit++)
+    if (0 != (fc->in_flight & (1LL << bit)))
+      earliest = GNUNET_TIME_absolute_min (earliest,
+                                           fc->sent_at[bit]);
+  if (earliest.abs_value_us == GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us)
+    return;
+  fc->task
+    = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (GNUNET_TIME_absolute_add (earliest,
+                                                                                                  fc->cc->rto)),
+                                    &transmit_next,
+                                    fc);
+}
+
+
+/**
+ * Transmit the next fragment to the other peer if the congestion
+ * window permits, retransmitting fragments whose retransmission
+ * timeout expired.
+ *
+ * @param fc fragmentation context with congestion control
+ */
+static void
+transmit_next_cc (struct GNUNET_FRAGMENT_Context *fc)
+{
+  struct GNUNET_FRAGMENT_Congestion *cc = fc->cc;
+  char msg[fc->mtu];
+  struct FragmentHeader *fh;
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_TIME_Relative delay;
+  struct GNUNET_TIME_Absolute latest;
+  uint64_t timed_out;
+  uint64_t to_send;
+  unsigned int bit;
+  size_t fsize;
+
+  now = GNUNET_TIME_absolute_get ();
+  timed_out = 0;
+  latest = GNUNET_TIME_UNIT_ZERO_ABS;
+  for (bit = 0; bit < 64; bit++)
+    if ( (0 != (fc->in_flight & (1LL << bit))) &&
+         (GNUNET_TIME_absolute_add (fc->sent_at[bit],
+                                    cc->rto).abs_value_us <= now.abs_value_us) )
+    {
+      timed_out |= 1LL << bit;
+      latest = GNUNET_TIME_absolute_max (latest,
+                                         fc->sent_at[bit]);
+    }
+  if (0 != timed_out)
+  {
+    cc->lost += count_bits (timed_out);
+    cc_release (fc,
+                timed_out);
+    cc_on_timeout (cc,
+                   latest);
+    GNUNET_STATISTICS_update (fc->stats,
+                              _("# fragment retransmission timeouts"),
+                              1,
+                              GNUNET_NO);
+  }
+  to_send = fc->acks & ~fc->in_flight;
+  if (0 == to_send)
+  {
+    /* everything is in flight, wait for ACK or timeout */
+    cc_arm_timer (fc);
+    return;
+  }
+  if ( (cc->in_flight >= cc->cwnd) ||
+       ( (NULL != cc->wait_head) &&
+         (cc->wait_head->priority > fc->priority) ) )
+  {
+    /* no room, or a more important context is waiting for it */
+    cc_start_waiting (fc);
+    cc_arm_timer (fc);
+    cc_wake (cc);
+    return;
+  }
+  while (0 == (to_send & (1LL << fc->next_transmission)))
+    fc->next_transmission = (fc->next_transmission + 1) % 64;
+  bit = fc->next_transmission;
+  fsize = fragment_size (fc,
+                         bit);
+  if (NULL != fc->tracker)
+  {
+    delay = GNUNET_BANDWIDTH_tracker_get_delay (fc->tracker,
+                                                fsize);
+    if (delay.rel_value_us > 0)
+    {
+      fc->task = GNUNET_SCHEDULER_add_delayed (delay,
+                                               &transmit_next,
+                                               fc);
+      return;
+    }
+    GNUNET_BANDWIDTH_tracker_consume (fc->tracker,
+                                      fsize);
+  }
+  fc->next_transmission = (bit + 1) % 64;
+  fh = (struct FragmentHeader *) msg;
+  assemble_fragment (fc,
+                     bit,
+                     fsize,
+                     fh);
+  GNUNET_STATISTICS_update (fc->stats,
+                            _("# fragments transmitted"),
+                            1,
+                            GNUNET_NO);
+  if (0 != fc->sent_at[bit].abs_value_us)
+  {
+    fc->retransmitted |= 1LL << bit;
+    cc->retransmitted++;
+    GNUNET_STATISTICS_update (fc->stats,
+                              _("# fragments retransmitted"),
+                              1,
+                              GNUNET_NO);
+  }
+  fc->sent_at[bit] = now;
+  fc->in_flight |= 1LL << bit;
+  cc->in_flight++;
+  cc->sent++;
+  fc->proc_busy = GNUNET_YES;
+  fc->delay_until = now;
+  fc->num_transmissions++;
+  fc->proc (fc->proc_cls, &fh->header);
+}
+
+
+/**
+ * Process an acknowledgement for a context with congestion control.
+ * Fragments still missing that were transmitted before a fragment
+ * that is now acknowledged are considered lost.
+ *
+ * @param fc fragmentation context
+ * @param abits fragments the receiver is missing
+ */
+static void
+process_ack_cc (struct GNUNET_FRAGMENT_Context *fc,
+                uint64_t abits)
+{
+  struct GNUNET_FRAGMENT_Congestion *cc = fc->cc;
+  struct GNUNET_TIME_Absolute latest;
+  struct GNUNET_TIME_Absolute latest_lost;
+  struct GNUNET_TIME_Absolute sample;
+  uint64_t acked;
+  uint64_t lost;
+  unsigned int bit;
+
+  acked = fc->in_flight & ~abits;
+  if (0 == acked)
+    return;
+  latest = GNUNET_TIME_UNIT_ZERO_ABS;
+  sample = GNUNET_TIME_UNIT_ZERO_ABS;
+  for (bit = 0; bit < 64; bit++)
+  {
+    if (0 == (acked & (1LL << bit)))
+      continue;
+    latest = GNUNET_TIME_absolute_max (latest,
+                                       fc->sent_at[bit]);
+    if (0 == (fc->retransmitted & (1LL << bit)))
+      sample = GNUNET_TIME_absolute_max (sample,
+                                         fc->sent_at[bit]);
+  }
+  cc_release (fc,
+              acked);
+  if (0 != sample.abs_value_us)
+    cc_rtt_sample (cc,
+                   GNUNET_TIME_absolute_get_duration (sample));
+  cc_on_ack (cc,
+             count_bits (acked));
+  lost = 0;
+  latest_lost = GNUNET_TIME_UNIT_ZERO_ABS;
+  for (bit = 0; bit < 64; bit++)
+  {
+    if ( (0 == (fc->in_flight & abits & (1LL << bit))) ||
+         (fc->sent_at[bit].abs_value_us >= latest.abs_value_us) )
+      continue;
+    lost |= 1LL << bit;
+    latest_lost = GNUNET_TIME_absolute_max (latest_lost,
+                                            fc->sent_at[bit]);
+  }
+  if (0 == lost)
+    return;
+  cc->lost += count_bits (lost);
+  GNUNET_STATISTICS_update (fc->stats,
+                            _("# fragments lost"),
+                            count_bits (lost),
+                            GNUNET_NO);
+  cc_release (fc,
+              lost);
+  cc_on_loss (cc,
+              latest_lost);
+}
+
+
 /**
  * Transmit the next fragment to the other peer.
  *
@@ -175,7 +843,6 @@ transmit_next (void *cls,
 {
   struct GNUNET_FRAGMENT_Context *fc = cls;
   char msg[fc->mtu];
-  const char *mbuf;
   struct FragmentHeader *fh;
   struct GNUNET_TIME_Relative delay;
   unsigned int bit;
@@ -187,6 +854,11 @@ transmit_next (void *cls,
   GNUNET_assert (GNUNET_NO == fc->proc_busy);
   if (0 == fc->acks)
     return;                     /* all done */
+  if (NULL != fc->cc)
+  {
+    transmit_next_cc (fc);
+    return;
+  }
   /* calculate delay */
   wrap = 0;
   while (0 == (fc->acks & (1LL << fc->next_transmission)))
@@ -195,13 +867,8 @@ transmit_next (void *cls,
     wrap |= (0 == fc->next_transmission);
   }
   bit = fc->next_transmission;
-  size = ntohs (fc->msg->size);
-  if (bit == size / (fc->mtu - sizeof (struct FragmentHeader)))
-    fsize =
-        (size % (fc->mtu - sizeof (struct FragmentHeader))) +
-        sizeof (struct FragmentHeader);
-  else
-    fsize = fc->mtu;
+  fsize = fragment_size (fc,
+                         bit);
   if (NULL != fc->tracker)
     delay = GNUNET_BANDWIDTH_tracker_get_delay (fc->tracker, fsize);
   else
@@ -220,15 +887,11 @@ transmit_next (void *cls,
   }
 
   /* assemble fragmentation message */
-  mbuf = (const char *) &fc[1];
   fh = (struct FragmentHeader *) msg;
-  fh->header.size = htons (fsize);
-  fh->header.type = htons (GNUNET_MESSAGE_TYPE_FRAGMENT);
-  fh->fragment_id = htonl (fc->fragment_id);
-  fh->total_size = fc->msg->size;       /* already in big-endian */
-  fh->offset = htons ((fc->mtu - sizeof (struct FragmentHeader)) * bit);
-  memcpy (&fh[1], &mbuf[bit * (fc->mtu - sizeof (struct FragmentHeader))],
-          fsize - sizeof (struct FragmentHeader));
+  assemble_fragment (fc,
+                     bit,
+                     fsize,
+                     fh);
   if (NULL != fc->tracker)
     GNUNET_BANDWIDTH_tracker_consume (fc->tracker, fsize);
   GNUNET_STATISTICS_update (fc->stats,
@@ -348,6 +1011,76 @@ GNUNET_FRAGMENT_context_create (struct GNUNET_STATISTICS_Handle *stats,
 }
 
 
+/**
+ * Create a fragmentation context for the given message that
+ * transmits using the window of a congestion controller.  As many
+ * fragments as the window of @a cc permits are in flight at the
+ * same time, with the window shared by all contexts using @a cc.
+ * The acknowledgements are used as selective ACKs: fragments that
+ * are missing while fragments sent after them were received are
+ * retransmitted right away, others after a retransmission timeout
+ * derived from the measured round-trip time.  The wire format is
+ * the same as for #GNUNET_FRAGMENT_context_create().
+ *
+ * @param stats statistics context
+ * @param mtu the maximum message size for each fragment
+ * @param tracker bandwidth tracker to use for flow control (can be NULL)
+ * @param cc congestion controller for the receiver of @a msg
+ * @param msg the message to fragment
+ * @param proc function to call for each fragment to transmit
+ * @param proc_cls closure for @a proc
+ * @return the fragmentation context
+ */
+struct GNUNET_FRAGMENT_Context *
+GNUNET_FRAGMENT_context_create_cc (struct GNUNET_STATISTICS_Handle *stats,
+                                   uint16_t mtu,
+                                   struct GNUNET_BANDWIDTH_Tracker *tracker,
+                                   struct GNUNET_FRAGMENT_Congestion *cc,
+                                   const struct GNUNET_MessageHeader *msg,
+                                   GNUNET_FRAGMENT_MessageProcessor proc,
+                                   void *proc_cls)
+{
+  struct GNUNET_FRAGMENT_Context *fc;
+
+  fc = GNUNET_FRAGMENT_context_create (stats,
+                                       mtu,
+                                       tracker,
+                                       GNUNET_TIME_UNIT_ZERO,
+                                       cc->srtt,
+                                       msg,
+                                       proc,
+                                       proc_cls);
+  fc->cc = cc;
+  return fc;
+}
+
+
+/**
+ * Set the priority of a fragmentation context that uses a
+ * congestion controller.  When the window of the controller is
+ * full, contexts with a higher priority get the room that becomes
+ * available first, and contexts with a lower priority do not
+ * transmit while a context with a higher priority is waiting.
+ *
+ * @param fc fragmentation context created with
+ *        #GNUNET_FRAGMENT_context_create_cc()
+ * @param priority new priority, 0 (the default) is the lowest
+ */
+void
+GNUNET_FRAGMENT_context_set_priority (struct GNUNET_FRAGMENT_Context *fc,
+                                      unsigned int priority)
+{
+  GNUNET_assert (NULL != fc->cc);
+  fc->priority = priority;
+  if (GNUNET_YES != fc->waiting)
+    return;
+  /* move to the right position */
+  cc_stop_waiting (fc);
+  cc_start_waiting (fc);
+  cc_wake (fc->cc);
+}
+
+
 /**
  * Continuation to call from the 'proc' function after the fragment
  * has been transmitted (and hence the next fragment can now be
@@ -398,8 +1131,11 @@ GNUNET_FRAGMENT_process_ack (struct GNUNET_FRAGMENT_Context *fc,
   if (ntohl (fa->fragment_id) != fc->fragment_id)
     return GNUNET_SYSERR;       /* not our ACK */
   abits = GNUNET_ntohll (fa->bits);
-  if ( (GNUNET_YES == fc->wack) &&
-       (0 != fc->num_transmissions) )
+  if (NULL != fc->cc)
+    process_ack_cc (fc,
+                    abits);
+  else if ( (GNUNET_YES == fc->wack) &&
+            (0 != fc->num_transmissions) )
   {
     /* normal ACK, can update running average of delay... */
     fc->wack = GNUNET_NO;
@@ -452,6 +1188,20 @@ GNUNET_FRAGMENT_process_ack (struct GNUNET_FRAGMENT_Context *fc,
                               GNUNET_NO);
   }
   fc->acks = abits & fc->acks_mask;
+  if ( (NULL != fc->cc) &&
+       (0 != fc->acks) )
+  {
+    /* transmit what the window permits now */
+    if (GNUNET_NO == fc->proc_busy)
+    {
+      cc_stop_waiting (fc);
+      if (NULL != fc->task)
+        GNUNET_SCHEDULER_cancel (fc->task);
+      fc->task = GNUNET_SCHEDULER_add_now (&transmit_next, fc);
+    }
+    cc_wake (fc->cc);
+    return GNUNET_NO;
+  }
   if (0 != fc->acks)
   {
     /* more to transmit, do so right now (if tracker permits...) */
@@ -480,6 +1230,13 @@ GNUNET_FRAGMENT_process_ack (struct GNUNET_FRAGMENT_Context *fc,
     GNUNET_SCHEDULER_cancel (fc->task);
     fc->task = NULL;
   }
+  if (NULL != fc->cc)
+  {
+    cc_stop_waiting (fc);
+    cc_release (fc,
+                fc->in_flight);
+    cc_wake (fc->cc);
+  }
   return GNUNET_OK;
 }
 
@@ -501,6 +1258,14 @@ GNUNET_FRAGMENT_context_destroy (struct GNUNET_FRAGMENT_Context *fc,
 {
   if (fc->task != NULL)
     GNUNET_SCHEDULER_cancel (fc->task);
+  if (NULL != fc->cc)
+  {
+    cc_stop_waiting (fc);
+    cc_release (fc,
+                fc->in_flight);
+    fc->ack_delay = fc->cc->srtt;
+    cc_wake (fc->cc);
+  }
   if (NULL != ack_delay)
     *ack_delay = fc->ack_delay;
   if (NULL != msg_delay)
@@ -510,4 +1275,58 @@ GNUNET_FRAGMENT_context_destroy (struct GNUNET_FRAGMENT_Context *fc,
 }
 
 
+/**
+ * Create a congestion controller for the fragments sent to one peer.
+ *
+ * @return the congestion controller
+ */
+struct GNUNET_FRAGMENT_Congestion *
+GNUNET_FRAGMENT_congestion_create ()
+{
+  struct GNUNET_FRAGMENT_Congestion *cc;
+
+  cc = GNUNET_new (struct GNUNET_FRAGMENT_Congestion);
+  cc->cwnd = CC_INITIAL_WINDOW;
+  cc->ssthresh = 64 * CC_INITIAL_WINDOW;
+  cc->rto = CC_INITIAL_RTO;
+  return cc;
+}
+
+
+/**
+ * Destroy a congestion controller.  All fragmentation contexts
+ * using it must have been destroyed before.
+ *
+ * @param cc congestion controller to destroy
+ */
+void
+GNUNET_FRAGMENT_congestion_destroy (struct GNUNET_FRAGMENT_Congestion *cc)
+{
+  GNUNET_assert (NULL == cc->wait_head);
+  GNUNET_break (0 == cc->in_flight);
+  GNUNET_free (cc);
+}
+
+
+/**
+ * Obtain the current state of a congestion controller.
+ *
+ * @param cc congestion controller
+ * @param[out] info where to store the state
+ */
+void
+GNUNET_FRAGMENT_congestion_get_info (const struct GNUNET_FRAGMENT_Congestion *cc,
+                                     struct GNUNET_FRAGMENT_CongestionInfo *info)
+{
+  info->cwnd = (unsigned int) cc->cwnd;
+  info->ssthresh = (unsigned int) cc->ssthresh;
+  info->in_flight = cc->in_flight;
+  info->srtt = cc->srtt;
+  info->rto = cc->rto;
+  info->fragments_sent = cc->sent;
+  info->fragments_retransmitted = cc->retransmitted;
+  info->fragments_lost = cc->lost;
+}
+
+
 /* end of fragmentation.c */
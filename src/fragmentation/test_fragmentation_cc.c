@@ -0,0 +1,354 @@
+/*
+     This file is part of GNUnet
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file fragmentation/test_fragmentation_cc.c
+ * @brief test for fragmentation.c with congestion control, over
+ *        a simulated lossy link with latency
+ */
+#include "platform.h"
+#include "gnunet_fragmentation_lib.h"
+
+/**
+ * Number of messages to transmit.
+ */
+#define NUM_MSGS 100
+
+/**
+ * How many messages do we fragment at the same time?
+ */
+#define PARALLEL 4
+
+/**
+ * MTU to force on fragmentation (must be > 1k + 12)
+ */
+#define MTU 1111
+
+/**
+ * Simulate dropping of 1 out of how many messages? (must be > 1)
+ */
+#define DROPRATE 20
+
+/**
+ * One-way latency of the simulated link.
+ */
+#define LATENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 5)
+
+
+/**
+ * A fragment or ACK on the simulated link.
+ */
+struct Packet
+{
+  /**
+   * This is a DLL.
+   */
+  struct Packet *next;
+
+  /**
+   * This is a DLL.
+   */
+  struct Packet *prev;
+
+  /**
+   * Task delivering the packet.
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * Is this an ACK?
+   */
+  int is_ack;
+
+  /* followed by the message */
+};
+
+
+static int ret = 1;
+
+static unsigned int delivered;
+
+static unsigned int completed;
+
+static unsigned int started;
+
+/**
+ * Number of messages completed per slot; the messages of slot 0
+ * have a higher priority than the others.
+ */
+static unsigned int slot_completed[PARALLEL];
+
+static struct Packet *packet_head;
+
+static struct Packet *packet_tail;
+
+static struct GNUNET_DEFRAGMENT_Context *defrag;
+
+static struct GNUNET_FRAGMENT_Congestion *cc;
+
+static struct GNUNET_FRAGMENT_Context *frags[PARALLEL];
+
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+
+static void
+do_shutdown (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_FRAGMENT_CongestionInfo info;
+  struct Packet *p;
+  unsigned int i;
+
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  while (NULL != (p = packet_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (packet_head,
+                                 packet_tail,
+                                 p);
+    GNUNET_SCHEDULER_cancel (p->task);
+    GNUNET_free (p);
+  }
+  for (i = 0; i < PARALLEL; i++)
+    if (NULL != frags[i])
+    {
+      GNUNET_FRAGMENT_context_destroy (frags[i], NULL, NULL);
+      frags[i] = NULL;
+    }
+  GNUNET_FRAGMENT_congestion_get_info (cc,
+                                       &info);
+  FPRINTF (stderr,
+           "%u of %u messages with priority, cwnd %u, srtt %s, %llu fragments sent, %llu lost, %llu retransmitted\n",
+           slot_completed[0],
+           completed,
+           info.cwnd,
+           GNUNET_STRINGS_relative_time_to_string (info.srtt,
+                                                   GNUNET_YES),
+           (unsigned long long) info.fragments_sent,
+           (unsigned long long) info.fragments_lost,
+           (unsigned long long) info.fragments_retransmitted);
+  if ( (NUM_MSGS == completed) &&
+       (0 == info.in_flight) &&
+       (0 != info.fragments_lost) &&
+       (0 != info.fragments_retransmitted) &&
+       (0 != info.srtt.rel_value_us) &&
+       /* tolerate some loss due to duplicate fragment IDs */
+       (delivered >= NUM_MSGS - (NUM_MSGS / 20)) )
+    ret = 0;
+  GNUNET_FRAGMENT_congestion_destroy (cc);
+  GNUNET_DEFRAGMENT_context_destroy (defrag);
+}
+
+
+static void
+do_timeout (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  timeout_task = NULL;
+  GNUNET_break (0);
+  do_shutdown (NULL, NULL);
+}
+
+
+static void
+proc_msgs (void *cls,
+           const struct GNUNET_MessageHeader *hdr)
+{
+  unsigned int i;
+  const char *buf;
+
+  buf = (const char *) hdr;
+  for (i = sizeof (struct GNUNET_MessageHeader); i < ntohs (hdr->size); i++)
+    GNUNET_assert (buf[i] == (char) i);
+  delivered++;
+}
+
+
+static void
+proc_frac (void *cls,
+           const struct GNUNET_MessageHeader *hdr);
+
+
+/**
+ * Start fragmenting the next message in the given slot.
+ *
+ * @param slot index into #frags
+ */
+static void
+next_transmission (unsigned int slot)
+{
+  static char buf[MTU + 32 * 1024];
+  struct GNUNET_MessageHeader *msg;
+  unsigned int j;
+
+  if (0 == started)
+    for (j = 0; j < sizeof (buf); j++)
+      buf[j] = (char) j;
+  if (NUM_MSGS == started)
+    return;
+  msg = (struct GNUNET_MessageHeader *) buf;
+  msg->type = htons ((uint16_t) started);
+  msg->size = htons (sizeof (struct GNUNET_MessageHeader) +
+                     (1 + 173 * started) % (32 * 1024));
+  frags[slot] = GNUNET_FRAGMENT_context_create_cc (NULL /* no stats */,
+                                                   MTU,
+                                                   NULL,
+                                                   cc,
+                                                   msg,
+                                                   &proc_frac,
+                                                   &frags[slot]);
+  if (0 == slot)
+    GNUNET_FRAGMENT_context_set_priority (frags[slot],
+                                          1);
+  started++;
+}
+
+
+/**
+ * Deliver a packet from the simulated link.
+ */
+static void
+deliver (void *cls,
+         const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Packet *p = cls;
+  const struct GNUNET_MessageHeader *msg;
+  unsigned int i;
+
+  msg = (const struct GNUNET_MessageHeader *) &p[1];
+  GNUNET_CONTAINER_DLL_remove (packet_head,
+                               packet_tail,
+                               p);
+  if (GNUNET_NO == p->is_ack)
+  {
+    GNUNET_DEFRAGMENT_process_fragment (defrag,
+                                        msg);
+    GNUNET_free (p);
+    return;
+  }
+  for (i = 0; i < PARALLEL; i++)
+  {
+    if (NULL == frags[i])
+      continue;
+    if (GNUNET_OK != GNUNET_FRAGMENT_process_ack (frags[i],
+                                                  msg))
+      continue;
+    GNUNET_FRAGMENT_context_destroy (frags[i], NULL, NULL);
+    frags[i] = NULL;
+    completed++;
+    slot_completed[i]++;
+    next_transmission (i);
+    break;
+  }
+  GNUNET_free (p);
+  if (NUM_MSGS == completed)
+    do_shutdown (NULL, NULL);
+}
+
+
+/**
+ * Put a packet on the simulated link, unless we drop it.
+ *
+ * @param msg the packet
+ * @param is_ack #GNUNET_YES if @a msg is an ACK
+ */
+static void
+transmit (const struct GNUNET_MessageHeader *msg,
+          int is_ack)
+{
+  struct Packet *p;
+
+  if (0 == GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                     DROPRATE))
+    return;
+  p = GNUNET_malloc (sizeof (struct Packet) + ntohs (msg->size));
+  p->is_ack = is_ack;
+  memcpy (&p[1], msg, ntohs (msg->size));
+  GNUNET_CONTAINER_DLL_insert_tail (packet_head,
+                                    packet_tail,
+                                    p);
+  p->task = GNUNET_SCHEDULER_add_delayed (LATENCY,
+                                          &deliver,
+                                          p);
+}
+
+
+/**
+ * Process fragment (by putting it on the link).
+ */
+static void
+proc_frac (void *cls,
+           const struct GNUNET_MessageHeader *hdr)
+{
+  struct GNUNET_FRAGMENT_Context **fc = cls;
+
+  GNUNET_FRAGMENT_context_transmission_done (*fc);
+  transmit (hdr,
+            GNUNET_NO);
+}
+
+
+/**
+ * Process ACK (by putting it on the link).
+ */
+static void
+proc_acks (void *cls,
+           uint32_t msg_id,
+           const struct GNUNET_MessageHeader *hdr)
+{
+  transmit (hdr,
+            GNUNET_YES);
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  unsigned int i;
+
+  defrag = GNUNET_DEFRAGMENT_context_create (NULL,
+                                             MTU,
+                                             2 * PARALLEL,
+                                             NULL,
+                                             &proc_msgs,
+                                             &proc_acks);
+  cc = GNUNET_FRAGMENT_congestion_create ();
+  timeout_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MINUTES,
+                                               &do_timeout,
+                                               NULL);
+  for (i = 0; i < PARALLEL; i++)
+    next_transmission (i);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GNUNET_log_setup ("test-fragmentation-cc",
+                    "WARNING",
+                    NULL);
+  GNUNET_SCHEDULER_run (&run, NULL);
+  return ret;
+}
+
+/* end of test_fragmentation_cc.c */
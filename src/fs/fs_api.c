@@ -40,6 +40,13 @@
  */
 #define DEFAULT_MAX_PARALLEL_DOWNLOADS 16
 
+/**
+ * How long do we wait before writing a download or search result
+ * that changed to disk (so that a burst of changes causes only one
+ * write)?
+ */
+#define SYNC_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
 /**
  * Start the given job (send signal, remove from pending queue, update
  * counters and state).
@@ -1942,6 +1949,11 @@ GNUNET_FS_download_sync_ (struct GNUNET_FS_DownloadContext *dc)
   char *fn;
   char *dir;
 
+  if (NULL != dc->sync_task)
+  {
+    GNUNET_SCHEDULER_cancel (dc->sync_task);
+    dc->sync_task = NULL;
+  }
   if (0 != (dc->options & GNUNET_FS_DOWNLOAD_IS_PROBE))
     return; /* we don't sync probes */
   if (NULL == dc->serialization)
@@ -2030,6 +2042,42 @@ cleanup:
 }
 
 
+/**
+ * Task that writes a download that changed to disk.
+ *
+ * @param cls the `struct GNUNET_FS_DownloadContext`
+ * @param tc scheduler context, unused
+ */
+static void
+download_sync_task (void *cls,
+                    const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_FS_DownloadContext *dc = cls;
+
+  dc->sync_task = NULL;
+  GNUNET_FS_download_sync_ (dc);
+}
+
+
+/**
+ * Mark this download as changed; it will be written to disk after
+ * a short delay, so that many changes result in one write.
+ *
+ * @param dc the struct to sync eventually
+ */
+void
+GNUNET_FS_download_sync_later_ (struct GNUNET_FS_DownloadContext *dc)
+{
+  if (0 != (dc->options & GNUNET_FS_DOWNLOAD_IS_PROBE))
+    return; /* we don't sync probes */
+  if (NULL != dc->sync_task)
+    return;
+  dc->sync_task = GNUNET_SCHEDULER_add_delayed (SYNC_DELAY,
+                                                &download_sync_task,
+                                                dc);
+}
+
+
 /**
  * Synchronize this search result with its mirror
  * on disk.  Note that all internal FS-operations that change
@@ -2044,6 +2092,11 @@ GNUNET_FS_search_result_sync_ (struct GNUNET_FS_SearchResult *sr)
   struct GNUNET_BIO_WriteHandle *wh;
   char *uris;
 
+  if (NULL != sr->sync_task)
+  {
+    GNUNET_SCHEDULER_cancel (sr->sync_task);
+    sr->sync_task = NULL;
+  }
   if (NULL == sr->sc)
     return;
   uris = NULL;
@@ -2117,6 +2170,41 @@ cleanup:
 }
 
 
+/**
+ * Task that writes a search result that changed to disk.
+ *
+ * @param cls the `struct GNUNET_FS_SearchResult`
+ * @param tc scheduler context, unused
+ */
+static void
+search_result_sync_task (void *cls,
+                         const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_FS_SearchResult *sr = cls;
+
+  sr->sync_task = NULL;
+  GNUNET_FS_search_result_sync_ (sr);
+}
+
+
+/**
+ * Mark this search result as changed; it will be written to disk
+ * after a short delay, so that many changes result in one write.
+ *
+ * @param sr the struct to sync eventually
+ */
+void
+GNUNET_FS_search_result_sync_later_ (struct GNUNET_FS_SearchResult *sr)
+{
+  if ( (NULL == sr->sc) ||
+       (NULL != sr->sync_task) )
+    return;
+  sr->sync_task = GNUNET_SCHEDULER_add_delayed (SYNC_DELAY,
+                                                &search_result_sync_task,
+                                                sr);
+}
+
+
 /**
  * Synchronize this search struct with its mirror
  * on disk.  Note that all internal FS-operations that change
@@ -2284,9 +2372,9 @@ deserialize_unindex_file (void *cls,
   {
   case UNINDEX_STATE_HASHING:
     uc->fhc =
-        GNUNET_CRYPTO_hash_file (GNUNET_SCHEDULER_PRIORITY_IDLE, uc->filename,
-                                 HASHING_BLOCKSIZE,
-                                 &GNUNET_FS_unindex_process_hash_, uc);
+        GNUNET_CRYPTO_hash_file_offload (uc->filename,
+                                         HASHING_BLOCKSIZE,
+                                         &GNUNET_FS_unindex_process_hash_, uc);
     break;
   case UNINDEX_STATE_FS_NOTIFY:
     uc->state = UNINDEX_STATE_HASHING;
@@ -603,6 +603,12 @@ struct GNUNET_FS_SearchResult
    */
   struct GNUNET_SCHEDULER_Task * probe_cancel_task;
 
+  /**
+   * Task that will write this search result to disk (set if the
+   * result changed since it was last written), or NULL.
+   */
+  struct GNUNET_SCHEDULER_Task *sync_task;
+
   /**
    * When did the current probe become active?
    */
@@ -986,6 +992,16 @@ void
 GNUNET_FS_search_result_sync_ (struct GNUNET_FS_SearchResult *sr);
 
 
+/**
+ * Mark this search result as changed; it will be written to disk
+ * after a short delay, so that many changes result in one write.
+ *
+ * @param sr the struct to sync eventually
+ */
+void
+GNUNET_FS_search_result_sync_later_ (struct GNUNET_FS_SearchResult *sr);
+
+
 /**
  * Synchronize this download struct with its mirror
  * on disk.  Note that all internal FS-operations that change
@@ -998,6 +1014,16 @@ void
 GNUNET_FS_download_sync_ (struct GNUNET_FS_DownloadContext *dc);
 
 
+/**
+ * Mark this download as changed; it will be written to disk after
+ * a short delay, so that many changes result in one write.
+ *
+ * @param dc the struct to sync eventually
+ */
+void
+GNUNET_FS_download_sync_later_ (struct GNUNET_FS_DownloadContext *dc);
+
+
 /**
  * Create SUSPEND event for the given publish operation
  * and then clean up our state (without stop signal).
@@ -1543,6 +1569,17 @@ struct SearchRequestEntry
    */
   char *keyword;
 
+  /**
+   * Cipher context keyed with the UBlock decryption key derived
+   * from @e keyword, set up once when the search starts.
+   */
+  struct GNUNET_CRYPTO_SymmetricContext *cipher;
+
+  /**
+   * IV for decrypting UBlocks published under @e keyword.
+   */
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+
   /**
    * Map that contains a "struct GNUNET_FS_SearchResult" for each result that
    * was found under this keyword.  Note that the entries will point
@@ -1622,6 +1659,13 @@ struct GNUNET_FS_SearchContext
    */
   struct SearchRequestEntry *requests;
 
+  /**
+   * Map from the first 32 bits of each keyword's derived public key
+   * to the respective `struct SearchRequestEntry`, used to find the
+   * keyword for an incoming UBlock without trying each of them.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *dpub_map;
+
   /**
    * When did we start?
    */
@@ -1802,6 +1846,18 @@ struct DownloadRequest
    */
   int is_pending;
 
+  /**
+   * Entry in the download's window heap while this request waits for
+   * a slot in the request window (#GNUNET_FS_DOWNLOAD_OPTION_SWARM).
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * #GNUNET_YES if this request occupies a slot in the request window
+   * (#GNUNET_FS_DOWNLOAD_OPTION_SWARM).
+   */
+  int in_window;
+
 };
 
 
@@ -1937,6 +1993,22 @@ struct GNUNET_FS_DownloadContext
    */
   struct GNUNET_DISK_FileHandle *rfh;
 
+  /**
+   * Read-only mapping of @e rfh, NULL if the file could not be
+   * mapped (then blocks are read through @e rfh).
+   */
+  struct GNUNET_DISK_MapHandle *rmap;
+
+  /**
+   * Start of the mapping of @e rfh.
+   */
+  const char *rmap_addr;
+
+  /**
+   * Size of the mapping of @e rfh.
+   */
+  uint64_t rmap_size;
+
   /**
    * Map of active requests (those waiting for a response).  The key
    * is the hash of the encryped block (aka query).
@@ -1953,6 +2025,19 @@ struct GNUNET_FS_DownloadContext
    */
   struct DownloadRequest *pending_tail;
 
+  /**
+   * Requests waiting for a slot in the request window, IBLOCKs
+   * first and DBLOCKs interleaved over the file.  Only used with
+   * #GNUNET_FS_DOWNLOAD_OPTION_SWARM.
+   */
+  struct GNUNET_CONTAINER_Heap *window_heap;
+
+  /**
+   * Number of requests currently occupying a slot in the request
+   * window (pending or sent to the FS service).
+   */
+  unsigned int window_used;
+
   /**
    * Top-level download request.
    */
@@ -1974,6 +2059,12 @@ struct GNUNET_FS_DownloadContext
    */
   struct GNUNET_SCHEDULER_Task *task;
 
+  /**
+   * Task that will write this download to disk (set if the download
+   * progressed since it was last written), or NULL.
+   */
+  struct GNUNET_SCHEDULER_Task *sync_task;
+
   /**
    * What is the first offset that we're interested
    * in?
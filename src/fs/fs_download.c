@@ -28,6 +28,19 @@
 #include "fs_api.h"
 #include "fs_tree.h"
 
+/**
+ * How many block requests may a download with
+ * #GNUNET_FS_DOWNLOAD_OPTION_SWARM have outstanding at the FS
+ * service at once?
+ */
+#define DOWNLOAD_WINDOW_SIZE 256
+
+/**
+ * How many blocks of the existing file do we verify per scheduler
+ * task during bottom-up reconstruction?
+ */
+#define RECONSTRUCT_BATCH_SIZE 256
+
 
 /**
  * Determine if the given download (options and meta data) should cause
@@ -359,6 +372,63 @@ full_recursive_download (struct GNUNET_FS_DownloadContext *dc)
 }
 
 
+/**
+ * Open the existing target file of a download for reconstruction and
+ * map it into memory, so that blocks can be verified without a seek
+ * and a read per block.  If the file cannot be mapped (for example,
+ * because it is larger than the address space), blocks are read
+ * through @e rfh instead.
+ *
+ * @param dc download to open the file for
+ */
+static void
+open_reconstruction_file (struct GNUNET_FS_DownloadContext *dc)
+{
+  off_t size;
+
+  dc->rfh = GNUNET_DISK_file_open (dc->filename, GNUNET_DISK_OPEN_READ,
+                                   GNUNET_DISK_PERM_NONE);
+  if (NULL == dc->rfh)
+    return;
+  if ( (GNUNET_OK != GNUNET_DISK_file_handle_size (dc->rfh, &size)) ||
+       (size <= 0) ||
+       ((uint64_t) size != (uint64_t) (size_t) size) )
+    return;
+  dc->rmap_addr = GNUNET_DISK_file_map (dc->rfh, &dc->rmap,
+                                        GNUNET_DISK_MAP_TYPE_READ,
+                                        (size_t) size);
+  if (NULL == dc->rmap_addr)
+  {
+    dc->rmap = NULL;
+    return;
+  }
+  dc->rmap_size = (uint64_t) size;
+}
+
+
+/**
+ * Close the file (and mapping) used for reconstruction.
+ *
+ * @param dc download to close the file for
+ */
+static void
+close_reconstruction_file (struct GNUNET_FS_DownloadContext *dc)
+{
+  if (NULL != dc->rmap)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (dc->rmap));
+    dc->rmap = NULL;
+    dc->rmap_addr = NULL;
+    dc->rmap_size = 0;
+  }
+  if (NULL != dc->rfh)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (dc->rfh));
+    dc->rfh = NULL;
+  }
+}
+
+
 /**
  * Check if all child-downloads have completed (or trigger them if
  * necessary) and once we're completely done, signal completion (and
@@ -398,11 +468,7 @@ check_completed (struct GNUNET_FS_DownloadContext *dc)
     GNUNET_SCHEDULER_cancel (dc->task);
     dc->task = NULL;
   }
-  if (NULL != dc->rfh)
-  {
-    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (dc->rfh));
-    dc->rfh = NULL;
-  }
+  close_reconstruction_file (dc);
   GNUNET_FS_download_sync_ (dc);
 
   /* signal completion */
@@ -657,7 +723,7 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
   unsigned int i;
   struct DownloadRequest *drc;
   uint64_t child_block_size;
-  const struct ContentHashKey *chks;
+  const char *data;
   int up_done;
 
   GNUNET_assert (NULL != dc->rfh);
@@ -669,21 +735,31 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
   off = compute_disk_offset (total, dr->offset, dr->depth);
   if (dc->old_file_size < off + len)
     return;                     /* failure */
-  if (off != GNUNET_DISK_file_seek (dc->rfh, off, GNUNET_DISK_SEEK_SET))
+  if (NULL != dc->rmap_addr)
   {
-    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "seek", dc->filename);
-    return;                     /* failure */
+    if (dc->rmap_size < off + len)
+      return;                   /* failure */
+    data = &dc->rmap_addr[off];
   }
-  if (len != GNUNET_DISK_file_read (dc->rfh, block, len))
+  else
   {
-    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "read", dc->filename);
-    return;                     /* failure */
+    if (off != GNUNET_DISK_file_seek (dc->rfh, off, GNUNET_DISK_SEEK_SET))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "seek", dc->filename);
+      return;                   /* failure */
+    }
+    if (len != GNUNET_DISK_file_read (dc->rfh, block, len))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "read", dc->filename);
+      return;                   /* failure */
+    }
+    data = block;
   }
-  GNUNET_CRYPTO_hash (block, len, &key);
+  GNUNET_CRYPTO_hash (data, len, &key);
   if (0 != memcmp (&key, &dr->chk.key, sizeof (struct GNUNET_HashCode)))
     return;                     /* mismatch */
   if (GNUNET_OK !=
-      encrypt_existing_match (dc, &dr->chk, dr, block, len, GNUNET_NO))
+      encrypt_existing_match (dc, &dr->chk, dr, data, len, GNUNET_NO))
   {
     /* hash matches but encrypted block does not, really bad */
     dr->state = BRS_ERROR;
@@ -700,7 +776,6 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
 
   /* set CHKs for children */
   up_done = GNUNET_YES;
-  chks = (const struct ContentHashKey *) block;
   for (i = 0; i < dr->num_children; i++)
   {
     drc = dr->children[i];
@@ -710,7 +785,10 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
     if (BRS_INIT == drc->state)
     {
       drc->state = BRS_CHK_SET;
-      drc->chk = chks[drc->chk_idx];
+      /* 'data' may not be aligned if it points into the mapping */
+      memcpy (&drc->chk,
+              &data[drc->chk_idx * sizeof (struct ContentHashKey)],
+              sizeof (struct ContentHashKey));
       try_top_down_reconstruction (dc, drc);
     }
     if (BRS_DOWNLOAD_UP != drc->state)
@@ -721,6 +799,144 @@ try_top_down_reconstruction (struct GNUNET_FS_DownloadContext *dc,
 }
 
 
+/**
+ * Compute the position of a request in the request window of a
+ * download with #GNUNET_FS_DOWNLOAD_OPTION_SWARM.  IBLOCKs come
+ * before the blocks they point to (they unlock more requests), and
+ * blocks of the same depth are ordered by their bit-reversed index,
+ * which interleaves requests over the whole file instead of walking
+ * it subtree by subtree.
+ *
+ * @param dc download the request belongs to
+ * @param dr the request
+ * @return heap cost of the request, lower is requested earlier
+ */
+static GNUNET_CONTAINER_HeapCostType
+swarm_cost (struct GNUNET_FS_DownloadContext *dc,
+            const struct DownloadRequest *dr)
+{
+  uint64_t idx;
+  uint64_t rev;
+  unsigned int i;
+
+  idx = dr->offset / GNUNET_FS_tree_compute_tree_size (dr->depth);
+  rev = 0;
+  for (i = 0; i < 48; i++)
+  {
+    rev = (rev << 1) | (idx & 1);
+    idx >>= 1;
+  }
+  return (((uint64_t) (dc->treedepth - dr->depth)) << 48) | rev;
+}
+
+
+/**
+ * Queue a request for transmission to the FS service.  Normally the
+ * request goes straight to the pending list; with
+ * #GNUNET_FS_DOWNLOAD_OPTION_SWARM it waits in the window heap until
+ * #fill_window() finds a free slot for it.
+ *
+ * @param dc download the request belongs to
+ * @param dr request to queue
+ */
+static void
+queue_request (struct GNUNET_FS_DownloadContext *dc,
+               struct DownloadRequest *dr)
+{
+  if (0 == (dc->options & GNUNET_FS_DOWNLOAD_OPTION_SWARM))
+  {
+    GNUNET_CONTAINER_DLL_insert (dc->pending_head, dc->pending_tail, dr);
+    dr->is_pending = GNUNET_YES;
+    return;
+  }
+  if (NULL != dr->hn)
+    return;
+  if (NULL == dc->window_heap)
+    dc->window_heap =
+        GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  dr->hn = GNUNET_CONTAINER_heap_insert (dc->window_heap, dr,
+                                         swarm_cost (dc, dr));
+}
+
+
+/**
+ * Move waiting requests into the request window (and thus to the
+ * pending list) while it has free slots, and make sure the pending
+ * requests get transmitted.
+ *
+ * @param dc download to fill the window of
+ */
+static void
+fill_window (struct GNUNET_FS_DownloadContext *dc)
+{
+  struct DownloadRequest *dr;
+
+  if ( (NULL == dc->client) ||
+       (NULL == dc->window_heap) )
+    return;
+  while ( (dc->window_used < DOWNLOAD_WINDOW_SIZE) &&
+          (NULL != (dr = GNUNET_CONTAINER_heap_remove_root (dc->window_heap))) )
+  {
+    dr->hn = NULL;
+    dr->in_window = GNUNET_YES;
+    dc->window_used++;
+    GNUNET_CONTAINER_DLL_insert_tail (dc->pending_head, dc->pending_tail, dr);
+    dr->is_pending = GNUNET_YES;
+  }
+  if ( (NULL == dc->th) &&
+       (NULL != dc->pending_head) )
+    dc->th =
+        GNUNET_CLIENT_notify_transmit_ready (dc->client,
+                                             sizeof (struct SearchMessage),
+                                             GNUNET_CONSTANTS_SERVICE_TIMEOUT,
+                                             GNUNET_NO,
+                                             &transmit_download_request, dc);
+}
+
+
+/**
+ * A request is done (or no longer needed); release its slot in the
+ * request window or remove it from the window heap.
+ *
+ * @param dc download the request belongs to
+ * @param dr the request
+ */
+static void
+leave_window (struct GNUNET_FS_DownloadContext *dc,
+              struct DownloadRequest *dr)
+{
+  if (NULL != dr->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (dr->hn);
+    dr->hn = NULL;
+  }
+  if (GNUNET_YES == dr->in_window)
+  {
+    GNUNET_assert (dc->window_used > 0);
+    dc->window_used--;
+    dr->in_window = GNUNET_NO;
+  }
+}
+
+
+/**
+ * Forget the request window of a download (all requests are about
+ * to be freed or re-queued).
+ *
+ * @param dc download to reset
+ */
+static void
+destroy_window (struct GNUNET_FS_DownloadContext *dc)
+{
+  if (NULL != dc->window_heap)
+  {
+    GNUNET_CONTAINER_heap_destroy (dc->window_heap);
+    dc->window_heap = NULL;
+  }
+  dc->window_used = 0;
+}
+
+
 /**
  * Schedule the download of the specified block in the tree.
  *
@@ -773,8 +989,12 @@ schedule_block_download (struct GNUNET_FS_DownloadContext *dc,
                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
   if (NULL == dc->client)
     return;                     /* download not active */
-  GNUNET_CONTAINER_DLL_insert (dc->pending_head, dc->pending_tail, dr);
-  dr->is_pending = GNUNET_YES;
+  queue_request (dc, dr);
+  if (0 != (dc->options & GNUNET_FS_DOWNLOAD_OPTION_SWARM))
+  {
+    fill_window (dc);
+    return;
+  }
   if (NULL == dc->th)
     dc->th =
         GNUNET_CLIENT_notify_transmit_ready (dc->client,
@@ -1005,6 +1225,8 @@ process_result_with_request (void *cls, const struct GNUNET_HashCode * key,
     GNUNET_CONTAINER_DLL_remove (dc->pending_head, dc->pending_tail, dr);
     dr->is_pending = GNUNET_NO;
   }
+  leave_window (dc, dr);
+  fill_window (dc);
 
   GNUNET_CRYPTO_hash_to_aes_key (&dr->chk.key, &skey, &iv);
   if (-1 == GNUNET_CRYPTO_symmetric_decrypt (prc->data, prc->size, &skey, &iv, pt))
@@ -1130,7 +1352,7 @@ process_result_with_request (void *cls, const struct GNUNET_HashCode * key,
   if (0 == dr->depth)
   {
     /* bottom of the tree, no child downloads possible, just sync */
-    GNUNET_FS_download_sync_ (dc);
+    GNUNET_FS_download_sync_later_ (dc);
     return GNUNET_YES;
   }
 
@@ -1184,7 +1406,7 @@ process_result_with_request (void *cls, const struct GNUNET_HashCode * key,
       break;
     }
   }
-  GNUNET_FS_download_sync_ (dc);
+  GNUNET_FS_download_sync_later_ (dc);
   return GNUNET_YES;
 
 signal_error:
@@ -1202,6 +1424,7 @@ signal_error:
   GNUNET_CLIENT_disconnect (dc->client);
   dc->in_receive = GNUNET_NO;
   dc->client = NULL;
+  destroy_window (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   dc->top_request = NULL;
   GNUNET_CONTAINER_multihashmap_destroy (dc->active);
@@ -1390,7 +1613,9 @@ do_reconnect (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     return;
   }
   dc->client = client;
-  if (NULL != dc->pending_head)
+  fill_window (dc);
+  if ( (NULL == dc->th) &&
+       (NULL != dc->pending_head) )
   {
     dc->th =
         GNUNET_CLIENT_notify_transmit_ready (client,
@@ -1419,8 +1644,8 @@ retry_entry (void *cls, const struct GNUNET_HashCode * key, void *entry)
 
   dr->next = NULL;
   dr->prev = NULL;
-  GNUNET_CONTAINER_DLL_insert (dc->pending_head, dc->pending_tail, dr);
-  dr->is_pending = GNUNET_YES;
+  dr->in_window = GNUNET_NO;
+  queue_request (dc, dr);
   return GNUNET_OK;
 }
 
@@ -1448,6 +1673,7 @@ try_reconnect (struct GNUNET_FS_DownloadContext *dc)
     /* full reset of the pending list */
     dc->pending_head = NULL;
     dc->pending_tail = NULL;
+    dc->window_used = 0;
     GNUNET_CONTAINER_multihashmap_iterate (dc->active, &retry_entry, dc);
     GNUNET_CLIENT_disconnect (dc->client);
     dc->in_receive = GNUNET_NO;
@@ -1489,10 +1715,13 @@ activate_fs_download (void *cls, struct GNUNET_CLIENT_Connection *client)
   GNUNET_FS_download_make_status_ (&pi, dc);
   dc->pending_head = NULL;
   dc->pending_tail = NULL;
+  dc->window_used = 0;
   GNUNET_CONTAINER_multihashmap_iterate (dc->active, &retry_entry, dc);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Asking for transmission to FS service\n");
-  if (NULL != dc->pending_head)
+  fill_window (dc);
+  if ( (NULL == dc->th) &&
+       (NULL != dc->pending_head) )
   {
     dc->th =
         GNUNET_CLIENT_notify_transmit_ready (dc->client,
@@ -1638,11 +1867,7 @@ reconstruct_cont (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     GNUNET_SCHEDULER_cancel (dc->task);
     dc->task = NULL;
   }
-  if (NULL != dc->rfh)
-  {
-    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (dc->rfh));
-    dc->rfh = NULL;
-  }
+  close_reconstruction_file (dc);
   /* start "normal" download */
   dc->issue_requests = GNUNET_YES;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1652,7 +1877,8 @@ reconstruct_cont (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
 
 /**
- * Task requesting the next block from the tree encoder.
+ * Task requesting the next blocks from the tree encoder, up to
+ * #RECONSTRUCT_BATCH_SIZE of them before yielding to the scheduler.
  *
  * @param cls the 'struct GNUJNET_FS_DownloadContext' we're processing
  * @param tc task context
@@ -1661,9 +1887,19 @@ static void
 get_next_block (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct GNUNET_FS_DownloadContext *dc = cls;
+  unsigned int i;
 
   dc->task = NULL;
-  GNUNET_FS_tree_encoder_next (dc->te);
+  for (i = 0; i < RECONSTRUCT_BATCH_SIZE; i++)
+  {
+    GNUNET_FS_tree_encoder_next (dc->te);
+    /* stop once the encoder is done (#reconstruct_cont started the
+       normal download) or the file turned out to be complete */
+    if ( (GNUNET_YES == dc->issue_requests) ||
+         (BRS_DOWNLOAD_UP == dc->top_request->state) )
+      return;
+  }
+  dc->task = GNUNET_SCHEDULER_add_now (&get_next_block, dc);
 }
 
 
@@ -1708,7 +1944,6 @@ reconstruct_cb (void *cls, const struct ContentHashKey *chk, uint64_t offset,
 		  "Block %u < %u irrelevant for our range\n",
 		  chld,
 		  dr->children[0]->chk_idx);
-      dc->task = GNUNET_SCHEDULER_add_now (&get_next_block, dc);
       return; /* irrelevant block */
     }
     if (chld > dr->children[dr->num_children-1]->chk_idx)
@@ -1717,7 +1952,6 @@ reconstruct_cb (void *cls, const struct ContentHashKey *chk, uint64_t offset,
 		  "Block %u > %u irrelevant for our range\n",
 		  chld,
 		  dr->children[dr->num_children-1]->chk_idx);
-      dc->task = GNUNET_SCHEDULER_add_now (&get_next_block, dc);
       return; /* irrelevant block */
     }
     dr = dr->children[chld - dr->children[0]->chk_idx];
@@ -1756,6 +1990,7 @@ reconstruct_cb (void *cls, const struct ContentHashKey *chk, uint64_t offset,
 	GNUNET_CONTAINER_DLL_remove (dc->pending_head, dc->pending_tail, dr);
 	dr->is_pending = GNUNET_NO;
       }
+      leave_window (dc, dr);
       /* calculate how many bytes of payload this block
        * corresponds to */
       blen = GNUNET_FS_tree_compute_tree_size (dr->depth);
@@ -1806,7 +2041,6 @@ reconstruct_cb (void *cls, const struct ContentHashKey *chk, uint64_t offset,
     GNUNET_assert (0);
     break;
   }
-  dc->task = GNUNET_SCHEDULER_add_now (&get_next_block, dc);
   if ((dr == dc->top_request) && (dr->state == BRS_DOWNLOAD_UP))
     check_completed (dc);
 }
@@ -1833,6 +2067,14 @@ fh_reader (void *cls, uint64_t offset, size_t max, void *buf, char **emsg)
 
   if (NULL != emsg)
     *emsg = NULL;
+  if (NULL != dc->rmap_addr)
+  {
+    if (offset >= dc->rmap_size)
+      return 0;
+    ret = GNUNET_MIN (max, dc->rmap_size - offset);
+    memcpy (buf, &dc->rmap_addr[offset], ret);
+    return ret;
+  }
   if (offset != GNUNET_DISK_file_seek (fh, offset, GNUNET_DISK_SEEK_SET))
   {
     if (NULL != emsg)
@@ -1913,9 +2155,7 @@ GNUNET_FS_download_start_task_ (void *cls,
   GNUNET_FS_download_start_downloading_ (dc);
   /* attempt reconstruction from disk */
   if (GNUNET_YES == GNUNET_DISK_file_test (dc->filename))
-    dc->rfh =
-        GNUNET_DISK_file_open (dc->filename, GNUNET_DISK_OPEN_READ,
-                               GNUNET_DISK_PERM_NONE);
+    open_reconstruction_file (dc);
   if (dc->top_request->state == BRS_CHK_SET)
   {
     if (NULL != dc->rfh)
@@ -1932,13 +2172,9 @@ GNUNET_FS_download_start_task_ (void *cls,
         break;                  /* normal, some blocks already down */
       case BRS_DOWNLOAD_UP:
         /* already done entirely, party! */
-        if (NULL != dc->rfh)
-        {
-          /* avoid hanging on to file handle longer than
-           * necessary */
-          GNUNET_DISK_file_close (dc->rfh);
-          dc->rfh = NULL;
-        }
+        /* avoid hanging on to file handle longer than
+         * necessary */
+        close_reconstruction_file (dc);
         return;
       case BRS_ERROR:
         GNUNET_asprintf (&dc->emsg, _("Invalid URI"));
@@ -1965,13 +2201,9 @@ GNUNET_FS_download_start_task_ (void *cls,
     GNUNET_CONTAINER_meta_data_iterate (dc->meta, &match_full_data, dc);
     if (BRS_DOWNLOAD_UP == dc->top_request->state)
     {
-      if (NULL != dc->rfh)
-      {
-        /* avoid hanging on to file handle longer than
-         * necessary */
-        GNUNET_DISK_file_close (dc->rfh);
-        dc->rfh = NULL;
-      }
+      /* avoid hanging on to file handle longer than
+       * necessary */
+      close_reconstruction_file (dc);
       return;                   /* finished, status update was already done for us */
     }
   }
@@ -2011,6 +2243,8 @@ GNUNET_FS_download_signal_suspend_ (void *cls)
   struct GNUNET_FS_DownloadContext *dc = cls;
   struct GNUNET_FS_ProgressInfo pi;
 
+  if (NULL != dc->sync_task)
+    GNUNET_FS_download_sync_ (dc); /* write pending changes */
   if (NULL != dc->top)
     GNUNET_FS_end_top (dc->h, dc->top);
   while (NULL != dc->child_head)
@@ -2040,11 +2274,8 @@ GNUNET_FS_download_signal_suspend_ (void *cls)
     GNUNET_FS_tree_encoder_finish (dc->te, NULL);
     dc->te = NULL;
   }
-  if (NULL != dc->rfh)
-  {
-    GNUNET_DISK_file_close (dc->rfh);
-    dc->rfh = NULL;
-  }
+  close_reconstruction_file (dc);
+  destroy_window (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   if (NULL != dc->active)
   {
@@ -2341,6 +2572,11 @@ GNUNET_FS_download_stop (struct GNUNET_FS_DownloadContext *dc, int do_delete)
     GNUNET_SCHEDULER_cancel (dc->task);
     dc->task = NULL;
   }
+  if (NULL != dc->sync_task)
+  {
+    GNUNET_SCHEDULER_cancel (dc->sync_task);
+    dc->sync_task = NULL;
+  }
   search_was_null = (NULL == dc->search);
   if (NULL != dc->search)
   {
@@ -2377,6 +2613,7 @@ GNUNET_FS_download_stop (struct GNUNET_FS_DownloadContext *dc, int do_delete)
                                 dc->serialization);
   pi.status = GNUNET_FS_STATUS_DOWNLOAD_STOPPED;
   GNUNET_FS_download_make_status_ (&pi, dc);
+  destroy_window (dc);
   GNUNET_FS_free_download_request_ (dc->top_request);
   dc->top_request = NULL;
   if (NULL != dc->active)
@@ -1070,8 +1070,9 @@ GNUNET_FS_publish_main_ (void *cls,
     {
       p->start_time = GNUNET_TIME_absolute_get ();
       pc->fhc =
-          GNUNET_CRYPTO_hash_file (GNUNET_SCHEDULER_PRIORITY_IDLE, p->filename,
-                                   HASHING_BLOCKSIZE, &hash_for_index_cb, pc);
+          GNUNET_CRYPTO_hash_file_offload (p->filename,
+                                           HASHING_BLOCKSIZE,
+                                           &hash_for_index_cb, pc);
     }
     return;
   }
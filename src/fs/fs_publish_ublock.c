@@ -42,11 +42,11 @@
  * @param label label to use for key derivation
  * @param pub public key to use for key derivation
  */
-static void
-derive_ublock_encryption_key (struct GNUNET_CRYPTO_SymmetricSessionKey *skey,
-			      struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
-			      const char *label,
-			      const struct GNUNET_CRYPTO_EcdsaPublicKey *pub)
+void
+GNUNET_FS_ublock_derive_key_ (struct GNUNET_CRYPTO_SymmetricSessionKey *skey,
+                              struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                              const char *label,
+                              const struct GNUNET_CRYPTO_EcdsaPublicKey *pub)
 {
   struct GNUNET_HashCode key;
 
@@ -80,7 +80,7 @@ GNUNET_FS_ublock_decrypt_ (const void *input,
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
   struct GNUNET_CRYPTO_SymmetricSessionKey skey;
 
-  derive_ublock_encryption_key (&skey, &iv,
+  GNUNET_FS_ublock_derive_key_ (&skey, &iv,
 				label, ns);
   GNUNET_CRYPTO_symmetric_decrypt (input, input_len,
 			     &skey, &iv,
@@ -251,7 +251,7 @@ GNUNET_FS_publish_ublock_ (struct GNUNET_FS_Handle *h,
   /* get public key of the namespace */
   GNUNET_CRYPTO_ecdsa_key_get_public (ns,
 				    &pub);
-  derive_ublock_encryption_key (&skey, &iv,
+  GNUNET_FS_ublock_derive_key_ (&skey, &iv,
 				label, &pub);
 
   /* encrypt ublock */
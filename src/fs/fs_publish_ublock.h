@@ -34,6 +34,22 @@
 #include "gnunet_identity_service.h"
 
 
+/**
+ * Derive the key for symmetric encryption/decryption from
+ * the public key and the label.
+ *
+ * @param skey where to store symmetric key
+ * @param iv where to store the IV
+ * @param label label to use for key derivation
+ * @param pub public key to use for key derivation
+ */
+void
+GNUNET_FS_ublock_derive_key_ (struct GNUNET_CRYPTO_SymmetricSessionKey *skey,
+                              struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                              const char *label,
+                              const struct GNUNET_CRYPTO_EcdsaPublicKey *pub);
+
+
 /**
  * Decrypt the given UBlock, storing the result in output.
  *
@@ -228,7 +228,7 @@ probe_failure_handler (void *cls,
   GNUNET_FS_download_stop (sr->probe_ctx, GNUNET_YES);
   sr->probe_ctx = NULL;
   GNUNET_FS_stop_probe_ping_task_ (sr);
-  GNUNET_FS_search_result_sync_ (sr);
+  GNUNET_FS_search_result_sync_later_ (sr);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Probe #%u for search result %p failed\n",
 	      sr->availability_trials,
@@ -255,7 +255,7 @@ probe_success_handler (void *cls,
   GNUNET_FS_download_stop (sr->probe_ctx, GNUNET_YES);
   sr->probe_ctx = NULL;
   GNUNET_FS_stop_probe_ping_task_ (sr);
-  GNUNET_FS_search_result_sync_ (sr);
+  GNUNET_FS_search_result_sync_later_ (sr);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Probe #%u for search result %p succeeded\n",
 	      sr->availability_trials,
@@ -350,7 +350,7 @@ GNUNET_FS_search_probe_progress_ (void *cls,
     if (0 == sr->remaining_probe_time.rel_value_us)
       sr->probe_cancel_task =
         GNUNET_SCHEDULER_add_now (&probe_failure_handler, sr);
-    GNUNET_FS_search_result_sync_ (sr);
+    GNUNET_FS_search_result_sync_later_ (sr);
     break;
   default:
     GNUNET_break (0);
@@ -639,7 +639,10 @@ process_ksk_result (struct GNUNET_FS_SearchContext *sc,
     notify_client_chk_result (sc, sr);
   else
     notify_client_chk_update (sc, sr);
-  GNUNET_FS_search_result_sync_ (sr);
+  if (is_new)
+    GNUNET_FS_search_result_sync_ (sr);
+  else
+    GNUNET_FS_search_result_sync_later_ (sr);
   GNUNET_FS_search_start_probe_ (sr);
 }
 
@@ -718,11 +721,72 @@ process_sks_result (struct GNUNET_FS_SearchContext *sc,
 }
 
 
+/**
+ * Compute the key under which a derived public key is stored
+ * in the `dpub_map` of a search context.
+ *
+ * @param dpub derived public key
+ * @return the first 32 bits of @a dpub
+ */
+static uint32_t
+dpub_to_key (const struct GNUNET_CRYPTO_EcdsaPublicKey *dpub)
+{
+  uint32_t key;
+
+  memcpy (&key, dpub, sizeof (key));
+  return key;
+}
+
+
+/**
+ * Closure for #find_request_by_dpub().
+ */
+struct FindRequestContext
+{
+  /**
+   * Derived public key we are looking for.
+   */
+  const struct GNUNET_CRYPTO_EcdsaPublicKey *dpub;
+
+  /**
+   * Set to the matching entry, if any.
+   */
+  struct SearchRequestEntry *sre;
+};
+
+
+/**
+ * Check if the given search request entry is for the derived
+ * public key we are looking for.
+ *
+ * @param cls the `struct FindRequestContext`
+ * @param key the first 32 bits of the derived public key
+ * @param value a `struct SearchRequestEntry`
+ * @return #GNUNET_NO if we found the entry, #GNUNET_YES to continue
+ */
+static int
+find_request_by_dpub (void *cls,
+                      uint32_t key,
+                      void *value)
+{
+  struct FindRequestContext *frc = cls;
+  struct SearchRequestEntry *sre = value;
+
+  if (0 != memcmp (frc->dpub,
+                   &sre->dpub,
+                   sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey)))
+    return GNUNET_YES;
+  frc->sre = sre;
+  return GNUNET_NO;
+}
+
+
 /**
  * Decrypt a ublock using a 'keyword' as the passphrase.  Given the
  * KSK public key derived from the keyword, this function looks up
  * the original keyword in the search context and decrypts the
- * given ciphertext block.
+ * given ciphertext block with the key derived for that keyword
+ * when the search was started.
  *
  * @param sc search context with the keywords
  * @param dpub derived public key used for the search
@@ -739,30 +803,32 @@ decrypt_block_with_keyword (const struct GNUNET_FS_SearchContext *sc,
 			    size_t edata_size,
 			    char *data)
 {
-  const struct GNUNET_CRYPTO_EcdsaPrivateKey *anon;
-  struct GNUNET_CRYPTO_EcdsaPublicKey anon_pub;
-  unsigned int i;
+  struct FindRequestContext frc;
 
   /* find key */
-  for (i = 0; i < sc->uri->data.ksk.keywordCount; i++)
-    if (0 == memcmp (dpub,
-		     &sc->requests[i].dpub,
-		     sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey)))
-      break;
-  if (i == sc->uri->data.ksk.keywordCount)
+  frc.dpub = dpub;
+  frc.sre = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (sc->dpub_map,
+                                                dpub_to_key (dpub),
+                                                &find_request_by_dpub,
+                                                &frc);
+  if (NULL == frc.sre)
   {
     /* oops, does not match any of our keywords!? */
     GNUNET_break (0);
     return GNUNET_SYSERR;
   }
   /* decrypt */
-  anon = GNUNET_CRYPTO_ecdsa_key_get_anonymous ();
-  GNUNET_CRYPTO_ecdsa_key_get_public (anon, &anon_pub);
-  GNUNET_FS_ublock_decrypt_ (edata, edata_size,
-			     &anon_pub,
-			     sc->requests[i].keyword,
-			     data);
-  return i;
+  if (-1 ==
+      GNUNET_CRYPTO_symmetric_context_decrypt (frc.sre->cipher,
+                                               edata, edata_size,
+                                               &frc.sre->iv,
+                                               data))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  return frc.sre - sc->requests;
 }
 
 
@@ -1384,6 +1450,7 @@ GNUNET_FS_search_start_searching_ (struct GNUNET_FS_SearchContext *sc)
   const char *keyword;
   const struct GNUNET_CRYPTO_EcdsaPrivateKey *anon;
   struct GNUNET_CRYPTO_EcdsaPublicKey anon_pub;
+  struct GNUNET_CRYPTO_SymmetricSessionKey skey;
   struct SearchRequestEntry *sre;
 
   GNUNET_assert (NULL == sc->client);
@@ -1395,6 +1462,8 @@ GNUNET_FS_search_start_searching_ (struct GNUNET_FS_SearchContext *sc)
     sc->requests =
         GNUNET_malloc (sizeof (struct SearchRequestEntry) *
                        sc->uri->data.ksk.keywordCount);
+    sc->dpub_map =
+        GNUNET_CONTAINER_multihashmap32_create (sc->uri->data.ksk.keywordCount);
     for (i = 0; i < sc->uri->data.ksk.keywordCount; i++)
     {
       keyword = &sc->uri->data.ksk.keywords[i][1];
@@ -1407,6 +1476,14 @@ GNUNET_FS_search_start_searching_ (struct GNUNET_FS_SearchContext *sc)
       GNUNET_CRYPTO_hash (&sre->dpub,
 			  sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
 			  &sre->uquery);
+      GNUNET_FS_ublock_derive_key_ (&skey, &sre->iv,
+                                    keyword, &anon_pub);
+      sre->cipher = GNUNET_CRYPTO_symmetric_context_create (&skey);
+      memset (&skey, 0, sizeof (skey));
+      GNUNET_CONTAINER_multihashmap32_put (sc->dpub_map,
+                                           dpub_to_key (&sre->dpub),
+                                           sre,
+                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
       sre->mandatory = (sc->uri->data.ksk.keywords[i][0] == '+');
       if (sre->mandatory)
         sc->mandatory_count++;
@@ -1425,6 +1502,32 @@ GNUNET_FS_search_start_searching_ (struct GNUNET_FS_SearchContext *sc)
 }
 
 
+/**
+ * Release the per-keyword state of a keyword search.
+ *
+ * @param sc search context to clean up
+ */
+static void
+free_search_requests (struct GNUNET_FS_SearchContext *sc)
+{
+  unsigned int i;
+
+  if (NULL == sc->requests)
+    return;
+  GNUNET_assert (GNUNET_FS_uri_test_ksk (sc->uri));
+  for (i = 0; i < sc->uri->data.ksk.keywordCount; i++)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (sc->requests[i].results);
+    GNUNET_CRYPTO_symmetric_context_destroy (sc->requests[i].cipher);
+    GNUNET_free (sc->requests[i].keyword);
+  }
+  GNUNET_free (sc->requests);
+  sc->requests = NULL;
+  GNUNET_CONTAINER_multihashmap32_destroy (sc->dpub_map);
+  sc->dpub_map = NULL;
+}
+
+
 /**
  * Freeze probes for the given search result.
  *
@@ -1507,6 +1610,8 @@ search_result_suspend (void *cls,
     sr->update_search = NULL;
   }
   GNUNET_FS_search_stop_probe_ (sr);
+  if (NULL != sr->sync_task)
+    GNUNET_FS_search_result_sync_ (sr); /* write pending changes */
   if (0 == sr->mandatory_missing)
   {
     /* client is aware of search result, notify about suspension event */
@@ -1537,7 +1642,6 @@ GNUNET_FS_search_signal_suspend_ (void *cls)
 {
   struct GNUNET_FS_SearchContext *sc = cls;
   struct GNUNET_FS_ProgressInfo pi;
-  unsigned int i;
 
   GNUNET_FS_end_top (sc->h, sc->top);
   GNUNET_CONTAINER_multihashmap_iterate (sc->master_result_map,
@@ -1556,16 +1660,7 @@ GNUNET_FS_search_signal_suspend_ (void *cls)
     sc->client = NULL;
   }
   GNUNET_CONTAINER_multihashmap_destroy (sc->master_result_map);
-  if (NULL != sc->requests)
-  {
-    GNUNET_assert (GNUNET_FS_uri_test_ksk (sc->uri));
-    for (i = 0; i < sc->uri->data.ksk.keywordCount; i++)
-    {
-      GNUNET_CONTAINER_multihashmap_destroy (sc->requests[i].results);
-      GNUNET_free (sc->requests[i].keyword);
-    }
-  }
-  GNUNET_free_non_null (sc->requests);
+  free_search_requests (sc);
   GNUNET_free_non_null (sc->emsg);
   GNUNET_FS_uri_destroy (sc->uri);
   GNUNET_free_non_null (sc->serialization);
@@ -1664,6 +1759,11 @@ search_result_stop (void *cls,
   struct GNUNET_FS_ProgressInfo pi;
 
   GNUNET_FS_search_stop_probe_ (sr);
+  if (NULL != sr->sync_task)
+  {
+    GNUNET_SCHEDULER_cancel (sr->sync_task);
+    sr->sync_task = NULL;
+  }
   if (NULL != sr->download)
   {
     sr->download->search = NULL;
@@ -1741,7 +1841,6 @@ void
 GNUNET_FS_search_stop (struct GNUNET_FS_SearchContext *sc)
 {
   struct GNUNET_FS_ProgressInfo pi;
-  unsigned int i;
 
   if (NULL != sc->top)
     GNUNET_FS_end_top (sc->h, sc->top);
@@ -1773,13 +1872,7 @@ GNUNET_FS_search_stop (struct GNUNET_FS_SearchContext *sc)
   GNUNET_CONTAINER_multihashmap_iterate (sc->master_result_map,
                                          &search_result_free, sc);
   GNUNET_CONTAINER_multihashmap_destroy (sc->master_result_map);
-  if (NULL != sc->requests)
-  {
-    GNUNET_assert (GNUNET_FS_uri_test_ksk (sc->uri));
-    for (i = 0; i < sc->uri->data.ksk.keywordCount; i++)
-      GNUNET_CONTAINER_multihashmap_destroy (sc->requests[i].results);
-  }
-  GNUNET_free_non_null (sc->requests);
+  free_search_requests (sc);
   GNUNET_free_non_null (sc->emsg);
   GNUNET_FS_uri_destroy (sc->uri);
   GNUNET_free (sc);
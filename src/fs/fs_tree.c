@@ -26,6 +26,70 @@
  */
 #include "platform.h"
 #include "fs_tree.h"
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+
+/**
+ * How many DBLOCKs do we read and encode at once (so that we
+ * can encode them in parallel)?
+ */
+#define TE_BATCH_SIZE 32
+
+/**
+ * Maximum number of threads used to encode a batch of DBLOCKs.
+ */
+#define TE_MAX_THREADS 8
+
+
+/**
+ * A DBLOCK that was read and encoded ahead of time.
+ */
+struct EncodedBlock
+{
+  /**
+   * CHK of the block.
+   */
+  struct ContentHashKey chk;
+
+  /**
+   * Plaintext of the block.
+   */
+  char pt[DBLOCK_SIZE];
+
+  /**
+   * Encrypted block.
+   */
+  char enc[DBLOCK_SIZE];
+
+  /**
+   * Size of the block.
+   */
+  uint16_t size;
+};
+
+
+/**
+ * A share of a batch of DBLOCKs, encoded by one thread.
+ */
+struct EncodeShare
+{
+  /**
+   * The batch.
+   */
+  struct EncodedBlock *batch;
+
+  /**
+   * First block of the share.
+   */
+  unsigned int start;
+
+  /**
+   * One past the last block of the share.
+   */
+  unsigned int end;
+};
 
 
 /**
@@ -108,6 +172,22 @@ struct GNUNET_FS_TreeEncoder
    */
   struct ContentHashKey *chk_tree;
 
+  /**
+   * DBLOCKs that were already read and encoded, array of
+   * #TE_BATCH_SIZE entries (allocated on first use).
+   */
+  struct EncodedBlock *batch;
+
+  /**
+   * Number of valid entries in @e batch.
+   */
+  unsigned int batch_len;
+
+  /**
+   * Next entry in @e batch to process.
+   */
+  unsigned int batch_off;
+
   /**
    * Are we currently in 'GNUNET_FS_tree_encoder_next'?
    * Flag used to prevent recursion.
@@ -321,6 +401,132 @@ compute_chk_offset (unsigned int depth, uint64_t end_offset)
 }
 
 
+/**
+ * Compute the CHKs and encrypted blocks of one share of a batch.
+ * DBLOCKs do not depend on each other, so shares can be encoded
+ * by different threads; the result is the same as encoding the
+ * blocks one by one.
+ *
+ * @param cls the `struct EncodeShare`
+ * @return NULL
+ */
+static void *
+encode_share (void *cls)
+{
+  struct EncodeShare *es = cls;
+  struct EncodedBlock *eb;
+  struct GNUNET_CRYPTO_SymmetricSessionKey sk;
+  struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
+  unsigned int i;
+
+  for (i = es->start; i < es->end; i++)
+  {
+    eb = &es->batch[i];
+    GNUNET_CRYPTO_hash (eb->pt, eb->size, &eb->chk.key);
+    GNUNET_CRYPTO_hash_to_aes_key (&eb->chk.key, &sk, &iv);
+    GNUNET_CRYPTO_symmetric_encrypt (eb->pt, eb->size, &sk, &iv, eb->enc);
+    GNUNET_CRYPTO_hash (eb->enc, eb->size, &eb->chk.query);
+  }
+  return NULL;
+}
+
+
+/**
+ * Encode the blocks of the current batch, using one thread per
+ * available core (up to #TE_MAX_THREADS).
+ *
+ * @param te tree encoder to use
+ */
+static void
+encode_batch (struct GNUNET_FS_TreeEncoder *te)
+{
+  struct EncodeShare es[TE_MAX_THREADS];
+  unsigned int threads;
+  unsigned int i;
+#if HAVE_PTHREAD
+  pthread_t tid[TE_MAX_THREADS];
+  unsigned int started;
+  long cpus;
+#endif
+
+  threads = 1;
+#if HAVE_PTHREAD && defined(_SC_NPROCESSORS_ONLN)
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cpus > 1)
+    threads = GNUNET_MIN (GNUNET_MIN ((unsigned int) cpus, te->batch_len),
+                          TE_MAX_THREADS);
+#endif
+  for (i = 0; i < threads; i++)
+  {
+    es[i].batch = te->batch;
+    es[i].start = i * te->batch_len / threads;
+    es[i].end = (i + 1) * te->batch_len / threads;
+  }
+  if (1 == threads)
+  {
+    (void) encode_share (&es[0]);
+    return;
+  }
+#if HAVE_PTHREAD
+  /* the caller encodes the first share itself */
+  for (started = 1; started < threads; started++)
+    if (0 != pthread_create (&tid[started], NULL, &encode_share, &es[started]))
+      break;
+  (void) encode_share (&es[0]);
+  for (i = 1; i < started; i++)
+    GNUNET_break (0 == pthread_join (tid[i], NULL));
+  /* shares we could not start a thread for */
+  for (i = started; i < threads; i++)
+    (void) encode_share (&es[i]);
+#endif
+}
+
+
+/**
+ * Read and encode the next DBLOCKs, up to #TE_BATCH_SIZE of them
+ * and never past the end of the current IBLOCK.
+ *
+ * @param te tree encoder to use
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if reading
+ *         the first block failed (@e emsg is set)
+ */
+static int
+fill_batch (struct GNUNET_FS_TreeEncoder *te)
+{
+  struct EncodedBlock *eb;
+  uint64_t offset;
+
+  if (NULL == te->batch)
+    te->batch = GNUNET_malloc (TE_BATCH_SIZE * sizeof (struct EncodedBlock));
+  te->batch_off = 0;
+  te->batch_len = 0;
+  offset = te->publish_offset;
+  while (te->batch_len < TE_BATCH_SIZE)
+  {
+    eb = &te->batch[te->batch_len];
+    eb->size = GNUNET_MIN (DBLOCK_SIZE, te->size - offset);
+    if (eb->size !=
+        te->reader (te->cls, offset, eb->size, eb->pt, &te->emsg))
+    {
+      if (0 == te->batch_len)
+        return GNUNET_SYSERR;
+      /* process what we have, the error will be reported
+         once we try to read this block again */
+      GNUNET_free_non_null (te->emsg);
+      te->emsg = NULL;
+      break;
+    }
+    te->batch_len++;
+    offset += eb->size;
+    if ((offset == te->size) ||
+        (0 == offset % (CHK_PER_INODE * DBLOCK_SIZE)))
+      break;
+  }
+  encode_batch (te);
+  return GNUNET_OK;
+}
+
+
 /**
  * Encrypt the next block of the file (and call proc and progress
  * accordingly; or of course "cont" if we have already completed
@@ -332,10 +538,11 @@ void
 GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
 {
   struct ContentHashKey *mychk;
+  struct EncodedBlock *eb;
   const void *pt_block;
+  const char *enc;
   uint16_t pt_size;
-  char iob[DBLOCK_SIZE];
-  char enc[DBLOCK_SIZE];
+  char iob_enc[DBLOCK_SIZE];
   struct GNUNET_CRYPTO_SymmetricSessionKey sk;
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
   unsigned int off;
@@ -357,19 +564,21 @@ GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
   }
   if (0 == te->current_depth)
   {
-    /* read DBLOCK */
-    pt_size = GNUNET_MIN (DBLOCK_SIZE, te->size - te->publish_offset);
-    if (pt_size !=
-        te->reader (te->cls, te->publish_offset, pt_size, iob, &te->emsg))
+    /* get (read and encode, if needed) DBLOCK */
+    if ( (te->batch_off == te->batch_len) &&
+         (GNUNET_OK != fill_batch (te)) )
     {
       te->in_next = GNUNET_NO;
       te->cont (te->cls, NULL);
       return;
     }
-    pt_block = iob;
+    eb = &te->batch[te->batch_off++];
+    pt_size = eb->size;
+    pt_block = eb->pt;
   }
   else
   {
+    eb = NULL;
     pt_size =
         GNUNET_FS_tree_compute_iblock_size (te->current_depth,
                                             te->publish_offset);
@@ -381,10 +590,19 @@ GNUNET_FS_tree_encoder_next (struct GNUNET_FS_TreeEncoder *te)
               (unsigned long long) te->publish_offset, te->current_depth,
               (unsigned int) pt_size, (unsigned int) off);
   mychk = &te->chk_tree[te->current_depth * CHK_PER_INODE + off];
-  GNUNET_CRYPTO_hash (pt_block, pt_size, &mychk->key);
-  GNUNET_CRYPTO_hash_to_aes_key (&mychk->key, &sk, &iv);
-  GNUNET_CRYPTO_symmetric_encrypt (pt_block, pt_size, &sk, &iv, enc);
-  GNUNET_CRYPTO_hash (enc, pt_size, &mychk->query);
+  if (NULL != eb)
+  {
+    *mychk = eb->chk;
+    enc = eb->enc;
+  }
+  else
+  {
+    GNUNET_CRYPTO_hash (pt_block, pt_size, &mychk->key);
+    GNUNET_CRYPTO_hash_to_aes_key (&mychk->key, &sk, &iv);
+    GNUNET_CRYPTO_symmetric_encrypt (pt_block, pt_size, &sk, &iv, iob_enc);
+    GNUNET_CRYPTO_hash (iob_enc, pt_size, &mychk->query);
+    enc = iob_enc;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "TE calculates query to be `%s', stored at %u\n",
               GNUNET_h2s (&mychk->query),
@@ -457,6 +675,7 @@ GNUNET_FS_tree_encoder_finish (struct GNUNET_FS_TreeEncoder *te,
   else
     GNUNET_free_non_null (te->emsg);
   GNUNET_free (te->chk_tree);
+  GNUNET_free_non_null (te->batch);
   GNUNET_free (te);
 }
 
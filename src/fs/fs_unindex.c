@@ -819,10 +819,9 @@ GNUNET_FS_unindex_start (struct GNUNET_FS_Handle *h,
   pi.value.unindex.eta = GNUNET_TIME_UNIT_FOREVER_REL;
   GNUNET_FS_unindex_make_status_ (&pi, uc, 0);
   uc->fhc =
-      GNUNET_CRYPTO_hash_file (GNUNET_SCHEDULER_PRIORITY_IDLE,
-                               filename,
-                               HASHING_BLOCKSIZE,
-                               &GNUNET_FS_unindex_process_hash_, uc);
+      GNUNET_CRYPTO_hash_file_offload (filename,
+                                       HASHING_BLOCKSIZE,
+                                       &GNUNET_FS_unindex_process_hash_, uc);
   uc->top = GNUNET_FS_make_top (h,
                                 &GNUNET_FS_unindex_signal_suspend_,
                                 uc);
@@ -28,11 +28,27 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
+#if HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
 
 #define MIN_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_HOURS, 4)
 
 #define MAX_FREQUENCY GNUNET_TIME_UNIT_MINUTES
 
+/**
+ * How long do we wait after a change was reported before we look
+ * at it (so that a burst of changes is handled at once)?
+ */
+#define CHANGE_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Events we watch for in the shared directory tree.
+ */
+#define INOTIFY_MASK (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB)
+#endif
+
 
 /**
  * Item in our work queue (or in the set of files/directories
@@ -64,6 +80,33 @@ struct WorkItem
 };
 
 
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Directory watched via inotify.
+ */
+struct Watch
+{
+
+  /**
+   * Watch descriptor.
+   */
+  int wd;
+
+  /**
+   * Name of the watched directory.
+   */
+  char *path;
+
+  /**
+   * Top-level entry of the shared directory this directory is in
+   * (what we have to republish on changes), NULL for the shared
+   * directory itself.
+   */
+  char *top;
+};
+#endif
+
+
 /**
  * Global return value from 'main'.
  */
@@ -162,6 +205,43 @@ static struct GNUNET_DISK_PipeHandle *sigpipe;
  */
 static struct GNUNET_OS_Process *publish_proc;
 
+#if HAVE_SYS_INOTIFY_H
+/**
+ * inotify file descriptor, -1 if we are not watching.
+ */
+static int inotify_fd = -1;
+
+/**
+ * Handle for #inotify_fd, NULL if we are not watching.
+ */
+static struct GNUNET_DISK_FileHandle *inotify_fh;
+
+/**
+ * Task reading events from #inotify_fh.
+ */
+static struct GNUNET_SCHEDULER_Task *inotify_task;
+
+/**
+ * Maps watch descriptors to `struct Watch` entries.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *watches;
+
+/**
+ * Top-level entries (`char *`) that changed, by hash of the name.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *dirty;
+
+/**
+ * Task processing the entries in #dirty.
+ */
+static struct GNUNET_SCHEDULER_Task *dirty_task;
+
+/**
+ * Set to #GNUNET_YES if we failed to add a watch.
+ */
+static int watch_failed;
+#endif
+
 
 /**
  * Compute the name of the state database file we will use.
@@ -313,6 +393,15 @@ save_state ()
 }
 
 
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Stop watching the shared directory.
+ */
+static void
+stop_watching (void);
+#endif
+
+
 /**
  * Task run on shutdown.  Serializes our current state to disk.
  *
@@ -325,6 +414,9 @@ do_stop_task (void *cls,
 {
   kill_task = NULL;
   do_shutdown = GNUNET_YES;
+#if HAVE_SYS_INOTIFY_H
+  stop_watching ();
+#endif
   if (NULL != publish_proc)
   {
     GNUNET_OS_process_kill (publish_proc, 
@@ -559,10 +651,11 @@ determine_id (void *cls,
 		      &fx[0]);
   if (!S_ISDIR (sbuf.st_mode))
   {
-    uint64_t fattr[2];
+    uint64_t fattr[3];
 
     fattr[0] = GNUNET_htonll (sbuf.st_size);
-    fattr[0] = GNUNET_htonll (sbuf.st_mtime);
+    fattr[1] = GNUNET_htonll (sbuf.st_mtime);
+    fattr[2] = GNUNET_htonll (sbuf.st_ino);
 
     GNUNET_CRYPTO_hash (fattr, 
 			sizeof (fattr), 
@@ -689,6 +782,12 @@ schedule_next_task ()
 								     100));
     delay = GNUNET_TIME_relative_max (delay,
 				      MAX_FREQUENCY);
+#if HAVE_SYS_INOTIFY_H
+    /* if we get told about changes, the scan is only a
+       consistency check */
+    if (NULL != inotify_fh)
+      delay = MIN_FREQUENCY;
+#endif
     run_task = GNUNET_SCHEDULER_add_delayed (delay,
 					     &scan,
 					     NULL);
@@ -701,6 +800,392 @@ schedule_next_task ()
 }
 
 
+#if HAVE_SYS_INOTIFY_H
+/**
+ * Add an inotify watch for the given directory.
+ *
+ * @param path directory to watch
+ * @param top top-level entry of the share the directory belongs to,
+ *        NULL for the shared directory itself
+ */
+static void
+add_watch (const char *path,
+           const char *top)
+{
+  struct Watch *w;
+  int wd;
+
+  if (-1 == inotify_fd)
+    return;
+  wd = inotify_add_watch (inotify_fd, path, INOTIFY_MASK);
+  if (-1 == wd)
+  {
+    /* most likely out of watches; fall back to periodic scans */
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "inotify_add_watch",
+                              path);
+    watch_failed = GNUNET_YES;
+    return;
+  }
+  if (NULL != GNUNET_CONTAINER_multihashmap32_get (watches, (uint32_t) wd))
+    return; /* already watched */
+  w = GNUNET_new (struct Watch);
+  w->wd = wd;
+  w->path = GNUNET_strdup (path);
+  w->top = (NULL == top) ? NULL : GNUNET_strdup (top);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap32_put (watches,
+                                                      (uint32_t) wd,
+                                                      w,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+}
+
+
+/**
+ * Add watches for a directory and all directories below it.
+ *
+ * @param cls the top-level entry (`const char *`) the tree belongs to
+ * @param filename file or directory found
+ * @return #GNUNET_OK to continue, #GNUNET_SYSERR if we ran out of watches
+ */
+static int
+watch_tree (void *cls,
+            const char *filename)
+{
+  const char *top = cls;
+
+  if (GNUNET_YES != GNUNET_DISK_directory_test (filename, GNUNET_YES))
+    return GNUNET_OK;
+  add_watch (filename, top);
+  if (GNUNET_YES == watch_failed)
+    return GNUNET_SYSERR;
+  (void) GNUNET_DISK_directory_scan (filename,
+                                     &watch_tree,
+                                     (void *) top);
+  return (GNUNET_YES == watch_failed) ? GNUNET_SYSERR : GNUNET_OK;
+}
+
+
+/**
+ * Add watches for a top-level entry of the shared directory.
+ *
+ * @param cls NULL
+ * @param filename top-level file or directory
+ * @return #GNUNET_OK to continue, #GNUNET_SYSERR if we ran out of watches
+ */
+static int
+watch_top (void *cls,
+           const char *filename)
+{
+  return watch_tree ((void *) filename, filename);
+}
+
+
+/**
+ * Free a watch (iterator over #watches).
+ *
+ * @param cls NULL
+ * @param key watch descriptor
+ * @param value the `struct Watch`
+ * @return #GNUNET_YES to continue to iterate
+ */
+static int
+free_watch (void *cls,
+            uint32_t key,
+            void *value)
+{
+  struct Watch *w = value;
+
+  GNUNET_free (w->path);
+  GNUNET_free_non_null (w->top);
+  GNUNET_free (w);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Free a dirty entry (iterator over #dirty).
+ *
+ * @param cls NULL
+ * @param key hash of the name
+ * @param value name of the top-level entry
+ * @return #GNUNET_YES to continue to iterate
+ */
+static int
+free_dirty (void *cls,
+            const struct GNUNET_HashCode *key,
+            void *value)
+{
+  GNUNET_free (value);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Stop watching the shared directory.
+ */
+static void
+stop_watching ()
+{
+  if (NULL != inotify_task)
+  {
+    GNUNET_SCHEDULER_cancel (inotify_task);
+    inotify_task = NULL;
+  }
+  if (NULL != dirty_task)
+  {
+    GNUNET_SCHEDULER_cancel (dirty_task);
+    dirty_task = NULL;
+  }
+  if (NULL != inotify_fh)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (inotify_fh));
+    inotify_fh = NULL;
+    inotify_fd = -1;
+  }
+  if (NULL != watches)
+  {
+    GNUNET_CONTAINER_multihashmap32_iterate (watches, &free_watch, NULL);
+    GNUNET_CONTAINER_multihashmap32_destroy (watches);
+    watches = NULL;
+  }
+  if (NULL != dirty)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (dirty, &free_dirty, NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (dirty);
+    dirty = NULL;
+  }
+}
+
+
+/**
+ * Check a top-level entry that changed and queue it if its state
+ * differs from what we published (iterator over #dirty).
+ *
+ * @param cls NULL
+ * @param key hash of the name
+ * @param value name of the top-level entry
+ * @return #GNUNET_YES to continue to iterate
+ */
+static int
+check_dirty (void *cls,
+             const struct GNUNET_HashCode *key,
+             void *value)
+{
+  char *top = value;
+  struct WorkItem *wi;
+
+  for (wi = work_head; NULL != wi; wi = wi->next)
+    if (0 == strcmp (wi->filename, top))
+      break;
+  if ( (NULL == wi) &&
+       (GNUNET_YES == GNUNET_DISK_file_test (top)) )
+    (void) add_file (NULL, top);
+  GNUNET_free (top);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Run a full scan now (unless we are busy publishing anyway),
+ * used when we may have missed changes.
+ */
+static void
+rescan_now ()
+{
+  if ( (NULL == run_task) ||
+       (NULL != publish_proc) ||
+       (NULL != work_head) )
+    return;
+  GNUNET_SCHEDULER_cancel (run_task);
+  run_task = GNUNET_SCHEDULER_add_now (&scan, NULL);
+}
+
+
+/**
+ * Process the changes collected from inotify.
+ *
+ * @param cls NULL
+ * @param tc scheduler context, unused
+ */
+static void
+process_changes (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  dirty_task = NULL;
+  if (NULL != publish_proc)
+  {
+    /* the entry being published might be among the changes; look
+       at them once the publication is done */
+    dirty_task = GNUNET_SCHEDULER_add_delayed (CHANGE_DELAY,
+                                               &process_changes,
+                                               NULL);
+    return;
+  }
+  GNUNET_CONTAINER_multihashmap_iterate (dirty, &check_dirty, NULL);
+  GNUNET_CONTAINER_multihashmap_clear (dirty);
+  if ( (NULL == work_head) ||
+       (GNUNET_YES == do_shutdown) )
+    return;
+  /* we are idle waiting for the next scan; start working now */
+  if (NULL != run_task)
+  {
+    GNUNET_SCHEDULER_cancel (run_task);
+    run_task = NULL;
+  }
+  schedule_next_task ();
+}
+
+
+/**
+ * Remember that the given top-level entry changed.
+ *
+ * @param top name of the entry
+ */
+static void
+mark_dirty (const char *top)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (top, strlen (top), &key);
+  if (GNUNET_YES == GNUNET_CONTAINER_multihashmap_contains (dirty, &key))
+    return;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (dirty,
+                                                    &key,
+                                                    GNUNET_strdup (top),
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  if (NULL == dirty_task)
+    dirty_task = GNUNET_SCHEDULER_add_delayed (CHANGE_DELAY,
+                                               &process_changes,
+                                               NULL);
+}
+
+
+/**
+ * Read events from inotify.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+read_inotify (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  char buf[64 * 1024] GNUNET_ALIGN;
+  const struct inotify_event *ev;
+  struct Watch *w;
+  ssize_t len;
+  size_t off;
+  char *path;
+  char *top;
+
+  inotify_task = NULL;
+  len = GNUNET_DISK_file_read (inotify_fh, buf, sizeof (buf));
+  if (len <= 0)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "read");
+    stop_watching ();
+    rescan_now ();
+    return;
+  }
+  for (off = 0; off + sizeof (struct inotify_event) <= (size_t) len;
+       off += sizeof (struct inotify_event) + ev->len)
+  {
+    ev = (const struct inotify_event *) &buf[off];
+    if (0 != (ev->mask & IN_Q_OVERFLOW))
+    {
+      /* lost events, do a full scan */
+      rescan_now ();
+      continue;
+    }
+    w = GNUNET_CONTAINER_multihashmap32_get (watches, (uint32_t) ev->wd);
+    if (NULL == w)
+      continue;
+    if (0 != (ev->mask & IN_IGNORED))
+    {
+      /* watched directory is gone */
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multihashmap32_remove (watches,
+                                                             (uint32_t) ev->wd,
+                                                             w));
+      (void) free_watch (NULL, (uint32_t) ev->wd, w);
+      continue;
+    }
+    path = NULL;
+    if (0 < ev->len)
+      GNUNET_asprintf (&path, "%s%s%s",
+                       w->path,
+                       DIR_SEPARATOR_STR,
+                       ev->name);
+    if (NULL != w->top)
+      top = GNUNET_strdup (w->top);
+    else if ( (NULL != path) &&
+              (0 != strncmp (ev->name, ".auto-share", strlen (".auto-share"))) )
+      top = GNUNET_strdup (path);
+    else
+      top = NULL;
+    if ( (NULL != path) &&
+         (NULL != top) &&
+         (0 != (ev->mask & IN_ISDIR)) &&
+         (0 != (ev->mask & (IN_CREATE | IN_MOVED_TO))) )
+      (void) watch_tree (top, path);
+    if (NULL != top)
+      mark_dirty (top);
+    GNUNET_free_non_null (top);
+    GNUNET_free_non_null (path);
+  }
+  if (GNUNET_YES == watch_failed)
+  {
+    stop_watching ();
+    rescan_now ();
+    return;
+  }
+  inotify_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 inotify_fh,
+                                                 &read_inotify,
+                                                 NULL);
+}
+
+
+/**
+ * Start watching the shared directory for changes.  If that is not
+ * possible (i.e. we run out of inotify watches), we stay with the
+ * periodic scans.
+ */
+static void
+start_watching ()
+{
+  inotify_fd = inotify_init ();
+  if (-1 == inotify_fd)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "inotify_init");
+    return;
+  }
+  inotify_fh = GNUNET_DISK_get_handle_from_int_fd (inotify_fd);
+  watches = GNUNET_CONTAINER_multihashmap32_create (1024);
+  dirty = GNUNET_CONTAINER_multihashmap_create (128, GNUNET_NO);
+  add_watch (dir_name, NULL);
+  if (GNUNET_YES != watch_failed)
+    (void) GNUNET_DISK_directory_scan (dir_name,
+                                       &watch_top,
+                                       NULL);
+  if (GNUNET_YES == watch_failed)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Could not watch `%s' for changes, using periodic scans\n"),
+                dir_name);
+    stop_watching ();
+    return;
+  }
+  inotify_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 inotify_fh,
+                                                 &read_inotify,
+                                                 NULL);
+}
+#endif
+
+
 /**
  * Main function that will be run by the scheduler.
  *
@@ -732,6 +1217,9 @@ run (void *cls,
   work_finished = GNUNET_CONTAINER_multihashmap_create (1024, 
 							GNUNET_NO);
   load_state ();
+#if HAVE_SYS_INOTIFY_H
+  start_watching ();
+#endif
   run_task = GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
 						 &scan, 
 						 NULL);
@@ -23,8 +23,9 @@
  * @brief daemon that publishes and downloads (random) files
  * @author Christian Grothoff
  *
- * TODO:
- * - how to signal driver that we're done?
+ * Progress is reported to the driver via statistics (subsystem
+ * "fsprofiler"), which the driver polls to detect completion and
+ * to sample throughput.
  */
 #include "platform.h"
 #include "gnunet_fs_service.h"
@@ -85,6 +86,16 @@ struct Pattern
    * Y-value.
    */
   unsigned long long y;
+
+  /**
+   * Number of bytes of the download completed so far.
+   */
+  uint64_t completed;
+
+  /**
+   * Name of the temporary file with the data to index, or NULL.
+   */
+  char *filename;
 };
 
 
@@ -123,6 +134,31 @@ static unsigned long long anonymity_level;
  */
 static unsigned long long replication_level;
 
+/**
+ * #GNUNET_YES to index published files, #GNUNET_NO to insert them.
+ */
+static int do_index;
+
+/**
+ * Bytes received by downloads that have already been stopped.
+ */
+static uint64_t bytes_downloaded_done;
+
+/**
+ * Number of downloads that completed successfully.
+ */
+static unsigned long long downloads_completed;
+
+/**
+ * Task that periodically reports progress via statistics.
+ */
+static struct GNUNET_SCHEDULER_Task *report_task;
+
+/**
+ * How often do we report progress?
+ */
+#define REPORT_FREQUENCY GNUNET_TIME_UNIT_SECONDS
+
 /**
  * String describing which publishing operations this peer should
  * perform.  The format is "(SIZE,SEED,TIME)*", for example:
@@ -217,52 +253,316 @@ make_keywords (uint64_t kval)
 
 
 /**
- * Create a file of the given length with a deterministic amount
- * of data to be published under keyword 'kval'.
+ * Produce the deterministic content of a file at the given offset.
+ * The data only depends on @a length and @a kval, making sure that
+ * blocks do not repeat.  As the content can be generated on demand,
+ * files do not have to fit into memory.
  *
  * @param length number of bytes in the file
  * @param kval keyword value and seed for the data of the file
- * @param ctx context to pass to 'fi'
+ * @param offset offset of the first byte to produce
+ * @param size number of bytes to produce
+ * @param buf where to write the data
+ */
+static void
+fill_data (uint64_t length,
+           uint64_t kval,
+           uint64_t offset,
+           size_t size,
+           char *buf)
+{
+  uint64_t xor;
+  uint64_t pos;
+  size_t off;
+  size_t n;
+
+  off = 0;
+  while (off < size)
+  {
+    pos = offset + off;
+    xor = length ^ kval ^ (uint64_t) (pos / 32 / 1024);
+    n = GNUNET_MIN (size - off,
+                    sizeof (uint64_t) - (size_t) (pos % sizeof (uint64_t)));
+    memcpy (&buf[off],
+            ((const char *) &xor) + (pos % sizeof (uint64_t)),
+            n);
+    off += n;
+  }
+}
+
+
+/**
+ * Function that provides the data of a file to publish.
+ *
+ * @param cls the `struct Pattern` of the publish operation
+ * @param offset offset to read from
+ * @param max maximum number of bytes to write to @a buf
+ * @param buf where to write the data
+ * @param emsg location for an error message
+ * @return @a max
+ */
+static size_t
+file_reader (void *cls,
+             uint64_t offset,
+             size_t max,
+             void *buf,
+             char **emsg)
+{
+  struct Pattern *p = cls;
+
+  if (0 == max)
+    return 0;
+  fill_data (p->x, p->y, offset, max, buf);
+  return max;
+}
+
+
+/**
+ * Write the content of the file for pattern @a p to a temporary
+ * file so that it can be indexed.
+ *
+ * @param p publish pattern with size and seed of the file
+ * @return #GNUNET_OK on success
+ */
+static int
+write_index_file (struct Pattern *p)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  char buf[64 * 1024];
+  uint64_t off;
+  size_t n;
+
+  p->filename = GNUNET_DISK_mktemp ("gnunet-fsprofiler");
+  if (NULL == p->filename)
+    return GNUNET_SYSERR;
+  fh = GNUNET_DISK_file_open (p->filename,
+                              GNUNET_DISK_OPEN_WRITE | GNUNET_DISK_OPEN_TRUNCATE,
+                              GNUNET_DISK_PERM_USER_READ | GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == fh)
+    return GNUNET_SYSERR;
+  for (off = 0; off < p->x; off += n)
+  {
+    n = (size_t) GNUNET_MIN (sizeof (buf), p->x - off);
+    fill_data (p->x, p->y, off, n, buf);
+    if (n != GNUNET_DISK_file_write (fh, buf, n))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "write",
+                                p->filename);
+      GNUNET_DISK_file_close (fh);
+      return GNUNET_SYSERR;
+    }
+  }
+  GNUNET_DISK_file_close (fh);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create a file of the given length with a deterministic amount
+ * of data to be published under keyword 'kval'.
+ *
+ * @param p publish pattern; x is the number of bytes in the file,
+ *        y the keyword value and seed for the data of the file
  * @return file information handle for the file
  */
 static struct GNUNET_FS_FileInformation *
-make_file (uint64_t length,
-	   uint64_t kval,
-	   void *ctx)
+make_file (struct Pattern *p)
 {
   struct GNUNET_FS_FileInformation *fi;
   struct GNUNET_FS_BlockOptions bo;
-  char *data;
   struct GNUNET_FS_Uri *keywords;
-  unsigned long long i;
-  uint64_t xor;
 
-  data = NULL; /* to make compilers happy */
-  if ( (0 != length) &&
-       (NULL == (data = GNUNET_malloc_large ((size_t) length))) )
-      return NULL;
-  /* initialize data with 'unique' data only depending on 'kval' and 'size',
-     making sure that blocks do not repeat */
-  for (i=0;i<length; i+=8)
-  {
-    xor = length ^ kval ^ (uint64_t) (i / 32 / 1024);
-    memcpy (&data[i], &xor, GNUNET_MIN (length - i, sizeof (uint64_t)));
-  }
   bo.expiration_time = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_DAYS);
   bo.anonymity_level = (uint32_t) anonymity_level;
   bo.content_priority = 128;
   bo.replication_level = (uint32_t) replication_level;
-  keywords = make_keywords (kval);
-  fi = GNUNET_FS_file_information_create_from_data (fs_handle,
-						    ctx,
-						    length,
-						    data, keywords,
-						    NULL, GNUNET_NO, &bo);
+  keywords = make_keywords (p->y);
+  if (GNUNET_YES == do_index)
+  {
+    if (GNUNET_OK != write_index_file (p))
+    {
+      GNUNET_FS_uri_destroy (keywords);
+      return NULL;
+    }
+    fi = GNUNET_FS_file_information_create_from_file (fs_handle,
+                                                      p,
+                                                      p->filename,
+                                                      keywords,
+                                                      NULL, GNUNET_YES, &bo);
+  }
+  else
+  {
+    fi = GNUNET_FS_file_information_create_from_reader (fs_handle,
+                                                        p,
+                                                        p->x,
+                                                        &file_reader, p,
+                                                        keywords,
+                                                        NULL, GNUNET_NO, &bo);
+  }
   GNUNET_FS_uri_destroy (keywords);
   return fi;
 }
 
 
+/**
+ * Release a pattern, removing the temporary file of an indexed
+ * publish operation (if any).
+ *
+ * @param p pattern to free
+ */
+static void
+free_pattern (struct Pattern *p)
+{
+  if (NULL != p->filename)
+  {
+    if (0 != UNLINK (p->filename))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                p->filename);
+    GNUNET_free (p->filename);
+  }
+  GNUNET_free (p);
+}
+
+
+#if LINUX
+/**
+ * Report CPU time and peak memory use of the given process
+ * as statistics of the form "# cpu time of NAME (ms)" and
+ * "# peak rss of NAME (KiB)".
+ *
+ * @param pid process to inspect
+ */
+static void
+report_process (pid_t pid)
+{
+  char fn[64];
+  char line[256];
+  char comm[64];
+  unsigned long utime;
+  unsigned long stime;
+  unsigned long long hwm;
+  char *stat_name;
+  FILE *f;
+  long ticks;
+
+  GNUNET_snprintf (fn, sizeof (fn), "/proc/%u/stat", (unsigned int) pid);
+  if (NULL == (f = FOPEN (fn, "r")))
+    return;
+  if (3 != fscanf (f,
+                   "%*d (%63[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+                   comm, &utime, &stime))
+  {
+    fclose (f);
+    return;
+  }
+  fclose (f);
+  if (0 != strncmp (comm, "gnunet-", strlen ("gnunet-")))
+    return;
+  ticks = sysconf (_SC_CLK_TCK);
+  if (ticks <= 0)
+    ticks = 100;
+  GNUNET_asprintf (&stat_name, "# cpu time of %s (ms)", comm);
+  GNUNET_STATISTICS_set (stats_handle,
+                         stat_name,
+                         (uint64_t) (utime + stime) * 1000LLU / ticks,
+                         GNUNET_NO);
+  GNUNET_free (stat_name);
+  GNUNET_snprintf (fn, sizeof (fn), "/proc/%u/status", (unsigned int) pid);
+  if (NULL == (f = FOPEN (fn, "r")))
+    return;
+  while (NULL != fgets (line, sizeof (line), f))
+  {
+    if (1 != sscanf (line, "VmHWM: %llu kB", &hwm))
+      continue;
+    GNUNET_asprintf (&stat_name, "# peak rss of %s (KiB)", comm);
+    GNUNET_STATISTICS_set (stats_handle,
+                           stat_name,
+                           hwm,
+                           GNUNET_NO);
+    GNUNET_free (stat_name);
+    break;
+  }
+  fclose (f);
+}
+
+
+/**
+ * Report resource usage of all services of this peer.  All of them
+ * are children of the ARM service that also started us.
+ */
+static void
+report_services ()
+{
+  char fn[64];
+  DIR *dir;
+  struct dirent *de;
+  FILE *f;
+  pid_t arm;
+  unsigned int pid;
+  unsigned int ppid;
+
+  arm = getppid ();
+  report_process (arm);
+  if (NULL == (dir = OPENDIR ("/proc")))
+    return;
+  while (NULL != (de = READDIR (dir)))
+  {
+    if (1 != sscanf (de->d_name, "%u", &pid))
+      continue;
+    GNUNET_snprintf (fn, sizeof (fn), "/proc/%u/stat", pid);
+    if (NULL == (f = FOPEN (fn, "r")))
+      continue;
+    if ( (1 == fscanf (f, "%*d (%*[^)]) %*c %u", &ppid)) &&
+         (ppid == (unsigned int) arm) )
+    {
+      fclose (f);
+      report_process ((pid_t) pid);
+      continue;
+    }
+    fclose (f);
+  }
+  CLOSEDIR (dir);
+}
+#endif
+
+
+/**
+ * Task that periodically reports the progress of our downloads
+ * and the resource usage of the peer via statistics.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+report_progress (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Pattern *p;
+  uint64_t total;
+
+  report_task = NULL;
+  total = bytes_downloaded_done;
+  for (p = download_head; NULL != p; p = p->next)
+    total += p->completed;
+  GNUNET_STATISTICS_set (stats_handle,
+                         "# bytes downloaded",
+                         total,
+                         GNUNET_NO);
+  GNUNET_STATISTICS_set (stats_handle,
+                         "# downloads completed",
+                         downloads_completed,
+                         GNUNET_NO);
+#if LINUX
+  report_services ();
+#endif
+  report_task = GNUNET_SCHEDULER_add_delayed (REPORT_FREQUENCY,
+                                              &report_progress,
+                                              NULL);
+}
+
+
 /**
  * Task run during shutdown.
  *
@@ -274,6 +574,11 @@ shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct Pattern *p;
 
+  if (NULL != report_task)
+  {
+    GNUNET_SCHEDULER_cancel (report_task);
+    report_task = NULL;
+  }
   while (NULL != (p = publish_head))
   {
     if (NULL != p->task)
@@ -281,7 +586,7 @@ shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     if (NULL != p->ctx)
       GNUNET_FS_publish_stop (p->ctx);
     GNUNET_CONTAINER_DLL_remove (publish_head, publish_tail, p);
-    GNUNET_free (p);
+    free_pattern (p);
   }
   while (NULL != (p = download_head))
   {
@@ -408,10 +713,19 @@ progress_cb (void *cls,
     p = info->value.publish.cctx;
     p->ctx = NULL;
     GNUNET_CONTAINER_DLL_remove (publish_head, publish_tail, p);
-    GNUNET_free (p);
+    free_pattern (p);
     return NULL;
-  case GNUNET_FS_STATUS_DOWNLOAD_START:
   case GNUNET_FS_STATUS_DOWNLOAD_PROGRESS:
+    p = info->value.download.cctx;
+    if ( (0 == p->completed) &&
+         (0 != info->value.download.completed) )
+      GNUNET_STATISTICS_update (stats_handle,
+                                "# time to first byte (ms)",
+                                (long long) GNUNET_TIME_absolute_get_duration (p->start_time).rel_value_us / 1000LL,
+                                GNUNET_NO);
+    p->completed = info->value.download.completed;
+    return p;
+  case GNUNET_FS_STATUS_DOWNLOAD_START:
   case GNUNET_FS_STATUS_DOWNLOAD_ACTIVE:
   case GNUNET_FS_STATUS_DOWNLOAD_INACTIVE:
     p = info->value.download.cctx;
@@ -430,11 +744,15 @@ progress_cb (void *cls,
 			      "# download time (ms)",
 			      (long long) GNUNET_TIME_absolute_get_duration (p->start_time).rel_value_us / 1000LL,
 			      GNUNET_NO);
+    downloads_completed++;
+    p->completed = info->value.download.size;
     p->task = GNUNET_SCHEDULER_add_now (&download_stop_task, p);
     return p;
   case GNUNET_FS_STATUS_DOWNLOAD_STOPPED:
     p = info->value.download.cctx;
     p->ctx = NULL;
+    bytes_downloaded_done += p->completed;
+    p->completed = 0;
     if (NULL == p->sctx)
     {
       GNUNET_CONTAINER_DLL_remove (download_head, download_tail, p);
@@ -510,7 +828,15 @@ start_publish (void *cls,
   p->task = NULL;
   if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
     return;
-  fi = make_file (p->x, p->y, p);
+  fi = make_file (p);
+  if (NULL == fi)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		"Failed to create file to publish\n");
+    GNUNET_STATISTICS_update (stats_handle,
+			      "# failed publish operations", 1, GNUNET_NO);
+    return;
+  }
   p->start_time = GNUNET_TIME_absolute_get ();
   p->ctx = GNUNET_FS_publish_start (fs_handle,
 				    fi,
@@ -586,6 +912,10 @@ run (void *cls, char *const *args GNUNET_UNUSED,
 					     "FSPROFILER", "REPLICATION_LEVEL",
                                              &replication_level))
     replication_level = 1;
+  do_index = GNUNET_CONFIGURATION_get_value_yesno (cfg,
+                                                   "FSPROFILER", "INDEX");
+  if (GNUNET_SYSERR == do_index)
+    do_index = GNUNET_NO;
   GNUNET_snprintf (myoptname, sizeof (myoptname),
 		   "DOWNLOAD-PATTERN-%u", my_peerid);
   if (GNUNET_OK !=
@@ -635,6 +965,8 @@ run (void *cls, char *const *args GNUNET_UNUSED,
   for (p = download_head; NULL != p; p = p->next)
     p->task = GNUNET_SCHEDULER_add_delayed (p->delay,
 					    &start_download, p);
+  report_task = GNUNET_SCHEDULER_add_now (&report_progress,
+                                          NULL);
 }
 
 
@@ -52,6 +52,8 @@ static char *filename;
 
 static int local_only;
 
+static int swarm;
+
 
 static void
 cleanup_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
@@ -274,6 +276,8 @@ run (void *cls, char *const *args, const char *cfgfile,
     options |= GNUNET_FS_DOWNLOAD_OPTION_RECURSIVE;
   if (local_only)
     options |= GNUNET_FS_DOWNLOAD_OPTION_LOOPBACK_ONLY;
+  if (swarm)
+    options |= GNUNET_FS_DOWNLOAD_OPTION_SWARM;
   dc = GNUNET_FS_download_start (ctx, uri, NULL, filename, NULL, 0,
                                  GNUNET_FS_uri_chk_get_file_size (uri),
                                  anonymity, options, NULL, NULL);
@@ -326,6 +330,9 @@ main (int argc, char *const *argv)
     {'V', "verbose", NULL,
      gettext_noop ("be verbose (print progress information)"),
      0, &GNUNET_GETOPT_increment_value, &verbose},
+    {'w', "swarm", NULL,
+     gettext_noop ("request blocks from all over the file within a bounded window"),
+     0, &GNUNET_GETOPT_set_one, &swarm},
     GNUNET_GETOPT_OPTION_END
   };
 
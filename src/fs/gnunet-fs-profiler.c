@@ -27,6 +27,70 @@
 #include "gnunet_util_lib.h"
 #include "gnunet_testbed_service.h"
 
+/**
+ * A statistic value collected from a peer at the end of the run.
+ */
+struct StatEntry
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct StatEntry *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct StatEntry *prev;
+
+  /**
+   * Name of the subsystem.
+   */
+  char *subsystem;
+
+  /**
+   * Name of the statistic.
+   */
+  char *name;
+
+  /**
+   * Value of the statistic.
+   */
+  uint64_t value;
+
+  /**
+   * Index of the peer in #peers.
+   */
+  unsigned int peer;
+};
+
+
+/**
+ * Aggregate download progress at one point in time.
+ */
+struct Sample
+{
+  /**
+   * Time since the start of the experiment.
+   */
+  struct GNUNET_TIME_Relative time;
+
+  /**
+   * Total number of bytes downloaded by all peers.
+   */
+  uint64_t bytes;
+
+  /**
+   * Number of completed downloads.
+   */
+  unsigned int completed;
+
+  /**
+   * Number of failed downloads.
+   */
+  unsigned int failed;
+};
+
+
 /**
  * Final status code.
  */
@@ -52,6 +116,251 @@ static struct GNUNET_TIME_Relative timeout;
  */
 static struct GNUNET_SCHEDULER_Task * terminate_taskid;
 
+/**
+ * Number of peers publishing the file.
+ */
+static unsigned int num_sources;
+
+/**
+ * Number of peers downloading the file.
+ */
+static unsigned int num_downloaders;
+
+/**
+ * Size of the file to publish and download.
+ */
+static unsigned long long file_size;
+
+/**
+ * Anonymity level to use for publishing and downloading.
+ */
+static unsigned int anonymity_level;
+
+/**
+ * Should the sources index (instead of insert) the file?
+ */
+static int do_index;
+
+/**
+ * How long should downloaders wait before they start searching?
+ */
+static struct GNUNET_TIME_Relative download_delay;
+
+/**
+ * How often do we sample download progress?
+ */
+static struct GNUNET_TIME_Relative sample_frequency;
+
+/**
+ * Emulated latency of each link (in each direction), or NULL.
+ */
+static char *link_delay;
+
+/**
+ * Emulated bandwidth of each link (in each direction), or NULL.
+ */
+static char *link_bandwidth;
+
+/**
+ * Emulated packet loss of each link in percent, or NULL.
+ */
+static char *link_loss;
+
+/**
+ * Timeline of link conditions to emulate, or NULL.
+ */
+static char *link_timeline;
+
+/**
+ * Where to write the JSON report, or NULL for plain text on stdout.
+ */
+static char *json_filename;
+
+/**
+ * Handles of the peers of the testbed.
+ */
+static struct GNUNET_TESTBED_Peer **peers;
+
+/**
+ * When did the experiment start?
+ */
+static struct GNUNET_TIME_Absolute start_time;
+
+/**
+ * Task sampling download progress.
+ */
+static struct GNUNET_SCHEDULER_Task *sample_task;
+
+/**
+ * Statistics operation of the current progress sample, or NULL.
+ */
+static struct GNUNET_TESTBED_Operation *sample_op;
+
+/**
+ * Progress sample currently being collected.
+ */
+static struct Sample current;
+
+/**
+ * Array of progress samples collected so far.
+ */
+static struct Sample *samples;
+
+/**
+ * Number of entries in #samples.
+ */
+static unsigned int num_samples;
+
+/**
+ * Head of the DLL of final statistics.
+ */
+static struct StatEntry *stat_head;
+
+/**
+ * Tail of the DLL of final statistics.
+ */
+static struct StatEntry *stat_tail;
+
+
+/**
+ * Find the index of a peer in #peers.
+ *
+ * @param peer peer to look for
+ * @return index of @a peer, #num_peers if not found
+ */
+static unsigned int
+peer_index (const struct GNUNET_TESTBED_Peer *peer)
+{
+  unsigned int i;
+
+  for (i = 0; i < num_peers; i++)
+    if (peers[i] == peer)
+      return i;
+  return num_peers;
+}
+
+
+/**
+ * Write a string as a JSON string literal.
+ *
+ * @param f where to write
+ * @param str string to write
+ */
+static void
+json_string (FILE *f,
+             const char *str)
+{
+  fputc ('"', f);
+  for (; '\0' != *str; str++)
+  {
+    if ( ('"' == *str) || ('\\' == *str) )
+      fprintf (f, "\\%c", *str);
+    else if ((unsigned char) *str < 0x20)
+      fprintf (f, "\\u%04x", (unsigned int) (unsigned char) *str);
+    else
+      fputc (*str, f);
+  }
+  fputc ('"', f);
+}
+
+
+/**
+ * Write the results of the experiment as JSON.
+ *
+ * @param f where to write
+ */
+static void
+write_json (FILE *f)
+{
+  struct StatEntry *se;
+  unsigned int i;
+  int first;
+
+  fprintf (f, "{\n  \"parameters\": {\n");
+  fprintf (f,
+           "    \"peers\": %u,\n    \"sources\": %u,\n    \"downloaders\": %u,\n",
+           num_peers, num_sources, num_downloaders);
+  fprintf (f,
+           "    \"file_size\": %llu,\n    \"anonymity\": %u,\n    \"indexed\": %s,\n",
+           file_size, anonymity_level,
+           (GNUNET_YES == do_index) ? "true" : "false");
+  fprintf (f, "    \"delay\": ");
+  json_string (f, (NULL != link_delay) ? link_delay : "");
+  fprintf (f, ",\n    \"bandwidth\": ");
+  json_string (f, (NULL != link_bandwidth) ? link_bandwidth : "");
+  fprintf (f, ",\n    \"loss\": ");
+  json_string (f, (NULL != link_loss) ? link_loss : "");
+  fprintf (f, "\n  },\n  \"samples\": [");
+  for (i = 0; i < num_samples; i++)
+    fprintf (f,
+             "%s\n    { \"time_ms\": %llu, \"bytes\": %llu, \"completed\": %u, \"failed\": %u }",
+             (0 == i) ? "" : ",",
+             (unsigned long long) samples[i].time.rel_value_us / 1000LL,
+             (unsigned long long) samples[i].bytes,
+             samples[i].completed,
+             samples[i].failed);
+  fprintf (f, "\n  ],\n  \"peers\": [");
+  for (i = 0; i < num_peers; i++)
+  {
+    fprintf (f,
+             "%s\n    { \"peer\": %u, \"role\": \"%s\", \"statistics\": {",
+             (0 == i) ? "" : ",",
+             i,
+             (i < num_sources) ? "source"
+             : (i < num_sources + num_downloaders) ? "downloader" : "relay");
+    first = GNUNET_YES;
+    for (se = stat_head; NULL != se; se = se->next)
+    {
+      if (se->peer != i)
+        continue;
+      fprintf (f, "%s\n      ", (GNUNET_YES == first) ? "" : ",");
+      first = GNUNET_NO;
+      json_string (f, se->subsystem);
+      fprintf (f, ": { ");
+      json_string (f, se->name);
+      fprintf (f, ": %llu }", (unsigned long long) se->value);
+    }
+    fprintf (f, "\n    } }");
+  }
+  fprintf (f, "\n  ]\n}\n");
+}
+
+
+/**
+ * Output the results of the experiment and release the
+ * collected statistics.
+ */
+static void
+report_results ()
+{
+  struct StatEntry *se;
+  FILE *f;
+
+  if (NULL != json_filename)
+  {
+    if (NULL == (f = FOPEN (json_filename, "w")))
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "fopen",
+                                json_filename);
+      ret = 1;
+    }
+    else
+    {
+      write_json (f);
+      fclose (f);
+    }
+  }
+  while (NULL != (se = stat_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (stat_head, stat_tail, se);
+    GNUNET_free (se->subsystem);
+    GNUNET_free (se->name);
+    GNUNET_free (se);
+  }
+  GNUNET_array_grow (samples, num_samples, 0);
+}
+
 
 /**
  * Function called after we've collected the statistics.
@@ -70,13 +379,14 @@ shutdown_task (void *cls,
     fprintf (stderr,
 	     "Error collecting statistics: %s\n",
 	     emsg);
+  report_results ();
   GNUNET_SCHEDULER_shutdown ();
 }
 
 
 /**
  * Callback function to process statistic values from all peers.
- * Prints them out.
+ * Prints them out (or stores them for the JSON report).
  *
  * @param cls closure
  * @param peer the peer the statistic belong to
@@ -94,19 +404,31 @@ process_stats (void *cls,
 	       uint64_t value,
 	       int is_persistent)
 {
-  fprintf (stdout,
-	   "%p-%s: %s = %llu\n",
-	   peer,
-	   subsystem,
-	   name,
-	   (unsigned long long) value);
+  struct StatEntry *se;
+
+  if (NULL == json_filename)
+  {
+    fprintf (stdout,
+             "%p-%s: %s = %llu\n",
+             peer,
+             subsystem,
+             name,
+             (unsigned long long) value);
+    return GNUNET_OK;
+  }
+  se = GNUNET_new (struct StatEntry);
+  se->subsystem = GNUNET_strdup (subsystem);
+  se->name = GNUNET_strdup (name);
+  se->value = value;
+  se->peer = peer_index (peer);
+  GNUNET_CONTAINER_DLL_insert_tail (stat_head, stat_tail, se);
   return GNUNET_OK;
 }
 
 
 /**
- * Task run on timeout to terminate.  Triggers printing out
- * all statistics.
+ * Task run on timeout (or once all downloads are done) to
+ * terminate.  Triggers printing out all statistics.
  *
  * @param cls NULL
  * @param tc unused
@@ -116,6 +438,16 @@ terminate_task (void *cls,
 		const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   terminate_taskid = NULL;
+  if (NULL != sample_task)
+  {
+    GNUNET_SCHEDULER_cancel (sample_task);
+    sample_task = NULL;
+  }
+  if (NULL != sample_op)
+  {
+    GNUNET_TESTBED_operation_done (sample_op);
+    sample_op = NULL;
+  }
   GNUNET_TESTBED_get_statistics (0, NULL,
                                  NULL, NULL,
 				 &process_stats,
@@ -124,13 +456,113 @@ terminate_task (void *cls,
 }
 
 
+/**
+ * Process the progress statistics of a peer.
+ *
+ * @param cls NULL
+ * @param peer the peer the statistic belong to
+ * @param subsystem name of subsystem that created the statistic
+ * @param name the name of the datum
+ * @param value the current value
+ * @param is_persistent #GNUNET_YES if the value is persistent
+ * @return #GNUNET_OK to continue
+ */
+static int
+process_sample (void *cls,
+                const struct GNUNET_TESTBED_Peer *peer,
+                const char *subsystem,
+                const char *name,
+                uint64_t value,
+                int is_persistent)
+{
+  if (0 == strcmp (name, "# bytes downloaded"))
+    current.bytes += value;
+  else if (0 == strcmp (name, "# downloads completed"))
+    current.completed += (unsigned int) value;
+  else if (0 == strcmp (name, "# failed downloads"))
+    current.failed += (unsigned int) value;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Task sampling the download progress of all peers.
+ *
+ * @param cls NULL
+ * @param tc unused
+ */
+static void
+sample_progress (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Function called once a progress sample has been collected.
+ * Terminates the experiment once all downloads are done.
+ *
+ * @param cls NULL
+ * @param op the operation that has been finished
+ * @param emsg error message, NULL on success
+ */
+static void
+sample_done (void *cls,
+             struct GNUNET_TESTBED_Operation *op,
+             const char *emsg)
+{
+  GNUNET_TESTBED_operation_done (sample_op);
+  sample_op = NULL;
+  if (NULL != emsg)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Error sampling progress: %s\n",
+                emsg);
+  }
+  else
+  {
+    current.time = GNUNET_TIME_absolute_get_duration (start_time);
+    GNUNET_array_append (samples, num_samples, current);
+    if ( (0 != num_downloaders) &&
+         (current.completed + current.failed >= num_downloaders) )
+    {
+      GNUNET_SCHEDULER_cancel (terminate_taskid);
+      terminate_taskid = GNUNET_SCHEDULER_add_now (&terminate_task,
+                                                   NULL);
+      return;
+    }
+  }
+  sample_task = GNUNET_SCHEDULER_add_delayed (sample_frequency,
+                                              &sample_progress,
+                                              NULL);
+}
+
+
+/**
+ * Task sampling the download progress of all peers.
+ *
+ * @param cls NULL
+ * @param tc unused
+ */
+static void
+sample_progress (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  sample_task = NULL;
+  memset (&current, 0, sizeof (current));
+  sample_op = GNUNET_TESTBED_get_statistics (num_peers, peers,
+                                             "fsprofiler", NULL,
+                                             &process_sample,
+                                             &sample_done,
+                                             NULL);
+}
+
+
 /**
  * Signature of a main function for a testcase.
  *
  * @param cls closure
  * @param h the run handle
- * @param num_peers number of peers in 'peers'
- * @param peers handle to peers run in the testbed
+ * @param num_peers_ number of peers in 'peers'
+ * @param peers_ handle to peers run in the testbed
  * @param links_succeeded the number of overlay link connection attempts that
  *          succeeded
  * @param links_failed the number of overlay link connection attempts that
@@ -139,15 +571,14 @@ terminate_task (void *cls,
 static void
 test_master (void *cls,
              struct GNUNET_TESTBED_RunHandle *h,
-             unsigned int num_peers,
-             struct GNUNET_TESTBED_Peer **peers,
+             unsigned int num_peers_,
+             struct GNUNET_TESTBED_Peer **peers_,
              unsigned int links_succeeded,
              unsigned int links_failed)
 {
-  // const struct GNUNET_CONFIGURATION_Handle *cfg = cls;
-  // FIXME: enable clients to signal 'completion' before timeout;
-  // in that case, run the 'terminate_task' "immediately"
-
+  num_peers = num_peers_;
+  peers = peers_;
+  start_time = GNUNET_TIME_absolute_get ();
   if (0 != timeout.rel_value_us)
     terminate_taskid = GNUNET_SCHEDULER_add_delayed (timeout,
 						     &terminate_task, NULL);
@@ -155,6 +586,84 @@ test_master (void *cls,
     terminate_taskid = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
 						     &terminate_task,
 						     NULL);
+  sample_task = GNUNET_SCHEDULER_add_delayed (sample_frequency,
+                                              &sample_progress,
+                                              NULL);
+}
+
+
+/**
+ * Set an emulation option for the links of all peers.
+ *
+ * @param cfg configuration to modify
+ * @param option name of the option without direction suffix
+ * @param value value to set, NULL to leave the option alone
+ * @param both #GNUNET_YES to set both the _IN and _OUT variants
+ */
+static void
+set_link_option (struct GNUNET_CONFIGURATION_Handle *cfg,
+                 const char *option,
+                 const char *value,
+                 int both)
+{
+  char *name;
+
+  if (NULL == value)
+    return;
+  if (GNUNET_NO == both)
+  {
+    GNUNET_CONFIGURATION_set_value_string (cfg, "TRANSPORT", option, value);
+    return;
+  }
+  GNUNET_asprintf (&name, "%s_IN", option);
+  GNUNET_CONFIGURATION_set_value_string (cfg, "TRANSPORT", name, value);
+  GNUNET_free (name);
+  GNUNET_asprintf (&name, "%s_OUT", option);
+  GNUNET_CONFIGURATION_set_value_string (cfg, "TRANSPORT", name, value);
+  GNUNET_free (name);
+}
+
+
+/**
+ * Configure the activities of the fsprofiler daemons: the first
+ * #num_sources peers publish the same (deterministic) file, the
+ * next #num_downloaders peers search for and download it.
+ *
+ * @param cfg configuration to modify
+ */
+static void
+configure_experiment (struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  char name[128];
+  char pattern[128];
+  unsigned int i;
+
+  GNUNET_CONFIGURATION_set_value_number (cfg, "FSPROFILER",
+                                         "ANONYMITY_LEVEL",
+                                         anonymity_level);
+  GNUNET_CONFIGURATION_set_value_string (cfg, "FSPROFILER", "INDEX",
+                                         (GNUNET_YES == do_index) ? "YES" : "NO");
+  GNUNET_snprintf (pattern, sizeof (pattern),
+                   "(%llu,1,0)",
+                   file_size);
+  for (i = 0; i < num_sources; i++)
+  {
+    GNUNET_snprintf (name, sizeof (name), "PUBLISH-PATTERN-%u", i);
+    GNUNET_CONFIGURATION_set_value_string (cfg, "FSPROFILER", name, pattern);
+  }
+  GNUNET_snprintf (pattern, sizeof (pattern),
+                   "(1,%llu,%llu)",
+                   file_size,
+                   (unsigned long long) download_delay.rel_value_us);
+  for (i = num_sources; i < num_sources + num_downloaders; i++)
+  {
+    GNUNET_snprintf (name, sizeof (name), "DOWNLOAD-PATTERN-%u", i);
+    GNUNET_CONFIGURATION_set_value_string (cfg, "FSPROFILER", name, pattern);
+  }
+  set_link_option (cfg, "MANIPULATE_DELAY", link_delay, GNUNET_YES);
+  set_link_option (cfg, "MANIPULATE_BANDWIDTH", link_bandwidth, GNUNET_YES);
+  set_link_option (cfg, "MANIPULATE_LOSS", link_loss, GNUNET_YES);
+  set_link_option (cfg, "MANIPULATE_TIMELINE", link_timeline, GNUNET_NO);
 }
 
 
@@ -170,11 +679,30 @@ static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
 {
+  struct GNUNET_CONFIGURATION_Handle *ecfg;
+
+  if (0 == num_peers)
+    num_peers = num_sources + num_downloaders;
+  if (num_peers < num_sources + num_downloaders)
+  {
+    fprintf (stderr,
+             _("Need at least %u peers for %u sources and %u downloaders\n"),
+             num_sources + num_downloaders,
+             num_sources,
+             num_downloaders);
+    ret = 1;
+    return;
+  }
+  if (0 == sample_frequency.rel_value_us)
+    sample_frequency = GNUNET_TIME_UNIT_SECONDS;
+  ecfg = GNUNET_CONFIGURATION_dup (cfg);
+  configure_experiment (ecfg);
   GNUNET_TESTBED_run (host_filename,
-		      cfg,
+		      ecfg,
 		      num_peers,
 		      0, NULL, NULL,
-		      &test_master, (void *) cfg);
+		      &test_master, NULL);
+  GNUNET_CONFIGURATION_destroy (ecfg);
 }
 
 
@@ -198,11 +726,48 @@ main (int argc, char *const *argv)
     {'t', "timeout", "DELAY",
      gettext_noop ("automatically terminate experiment after DELAY"),
      1, &GNUNET_GETOPT_set_relative_time, &timeout},
+    {'s', "sources", "COUNT",
+     gettext_noop ("number of peers publishing the file"),
+     1, &GNUNET_GETOPT_set_uint, &num_sources},
+    {'d', "downloaders", "COUNT",
+     gettext_noop ("number of peers downloading the file"),
+     1, &GNUNET_GETOPT_set_uint, &num_downloaders},
+    {'S', "size", "BYTES",
+     gettext_noop ("size of the file to transfer"),
+     1, &GNUNET_GETOPT_set_ulong, &file_size},
+    {'a', "anonymity", "LEVEL",
+     gettext_noop ("anonymity level to use for publishing and downloading"),
+     1, &GNUNET_GETOPT_set_uint, &anonymity_level},
+    {'i', "index", NULL,
+     gettext_noop ("index the file instead of inserting it"),
+     0, &GNUNET_GETOPT_set_one, &do_index},
+    {'w', "download-delay", "DELAY",
+     gettext_noop ("wait DELAY before downloaders start searching"),
+     1, &GNUNET_GETOPT_set_relative_time, &download_delay},
+    {'f', "frequency", "DELAY",
+     gettext_noop ("sample download progress every DELAY"),
+     1, &GNUNET_GETOPT_set_relative_time, &sample_frequency},
+    {'l', "latency", "DELAY",
+     gettext_noop ("emulate a latency of DELAY on each link"),
+     1, &GNUNET_GETOPT_set_string, &link_delay},
+    {'b', "bandwidth", "SIZE",
+     gettext_noop ("emulate a bandwidth of SIZE per second on each link"),
+     1, &GNUNET_GETOPT_set_string, &link_bandwidth},
+    {'L', "loss", "PERCENT",
+     gettext_noop ("emulate PERCENT packet loss on each link"),
+     1, &GNUNET_GETOPT_set_string, &link_loss},
+    {'T', "timeline", "FILENAME",
+     gettext_noop ("emulate the link conditions given in FILENAME over time"),
+     1, &GNUNET_GETOPT_set_filename, &link_timeline},
+    {'j', "json", "FILENAME",
+     gettext_noop ("write results as JSON to FILENAME"),
+     1, &GNUNET_GETOPT_set_filename, &json_filename},
     GNUNET_GETOPT_OPTION_END
   };
   if (GNUNET_OK != GNUNET_STRINGS_get_utf8_args (argc, argv, &argc, &argv))
     return 2;
-
+  file_size = 1024 * 1024;
+  anonymity_level = 1;
   ret = (GNUNET_OK ==
 	 GNUNET_PROGRAM_run (argc, argv, "gnunet-fs-profiler",
 			     gettext_noop ("run a testbed to measure file-sharing performance"), options, &run,
@@ -28,6 +28,24 @@
  */
 #include "platform.h"
 #include "gnunet_fs_service.h"
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+/**
+ * Maximum number of threads we use for extracting meta data.
+ */
+#define MAX_EXTRACT_THREADS 8
+
+/**
+ * How many files may the extraction workers be ahead of the file
+ * whose result we write next?  Bounds the memory used for results
+ * that cannot be written yet.
+ */
+#define EXTRACT_WINDOW 256
+
+
+struct EXTRACTOR_PluginList;
 
 
 /**
@@ -82,11 +100,16 @@ struct ScanTreeNode
 };
 
 
-#if HAVE_LIBEXTRACTOR
 /**
  * List of libextractor plugins to use for extracting.
  */
 static struct EXTRACTOR_PluginList *plugins;
+
+#if HAVE_LIBEXTRACTOR
+/**
+ * Custom plugin configuration for libextractor, NULL for defaults.
+ */
+static const char *extractor_config;
 #endif
 
 /**
@@ -364,81 +387,320 @@ preprocess_file (const char *filename,
 
 
 /**
- * Extract metadata from files.
+ * Extract the meta data of a file and build the body of the
+ * #GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_META_DATA message for it
+ * (0-terminated filename followed by the serialized meta data).
  *
- * @param item entry we are processing
- * @return #GNUNET_OK on success, #GNUNET_SYSERR on fatal errors
+ * @param filename file to process
+ * @param pl extractor plugins to use (NULL for none)
+ * @param msize set to the number of bytes in the result
+ * @return message body (caller must free)
  */
-static int
-extract_files (struct ScanTreeNode *item)
+static char *
+build_meta_message (const char *filename,
+                    struct EXTRACTOR_PluginList *pl,
+                    size_t *msize)
 {
   struct GNUNET_CONTAINER_MetaData *meta;
   ssize_t size;
   size_t slen;
-
-  if (GNUNET_YES == item->is_directory)
-  {
-    /* for directories, we simply only descent, no extraction, no
-       progress reporting */
-    struct ScanTreeNode *pos;
-
-    for (pos = item->children_head; NULL != pos; pos = pos->next)
-      if (GNUNET_OK !=
-	  extract_files (pos))
-	return GNUNET_SYSERR;
-    return GNUNET_OK;
-  }
+  char *buf;
+  char *dst;
 
   /* this is the expensive operation, *afterwards* we'll check for aborts */
   meta = GNUNET_CONTAINER_meta_data_create ();
 #if HAVE_LIBEXTRACTOR
-  EXTRACTOR_extract (plugins,
-                     item->filename,
-                     NULL, 0,
-                     &add_to_md,
-                     meta);
+  if (NULL != pl)
+    EXTRACTOR_extract (pl,
+                       filename,
+                       NULL, 0,
+                       &add_to_md,
+                       meta);
 #endif
-  slen = strlen (item->filename) + 1;
+  slen = strlen (filename) + 1;
   size = GNUNET_CONTAINER_meta_data_get_serialized_size (meta);
   if (-1 == size)
   {
     /* no meta data */
-    GNUNET_CONTAINER_meta_data_destroy (meta);
-    if (GNUNET_OK !=
-	write_message (GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_META_DATA,
-		       item->filename, slen))
-      return GNUNET_SYSERR;
-    return GNUNET_OK;
+    size = 0;
   }
   else if (size > (UINT16_MAX - sizeof (struct GNUNET_MessageHeader) - slen))
   {
     /* We can't transfer more than 64k bytes in one message. */
     size = UINT16_MAX - sizeof (struct GNUNET_MessageHeader) - slen;
   }
+  buf = GNUNET_malloc (slen + size);
+  memcpy (buf, filename, slen);
+  if (0 < size)
   {
-    char buf[size + slen];
-    char *dst = &buf[slen];
-
-    memcpy (buf, item->filename, slen);
+    dst = &buf[slen];
     size = GNUNET_CONTAINER_meta_data_serialize (meta,
-						 &dst, size,
-						 GNUNET_CONTAINER_META_DATA_SERIALIZE_PART);
+                                                 &dst, size,
+                                                 GNUNET_CONTAINER_META_DATA_SERIALIZE_PART);
     if (size < 0)
     {
       GNUNET_break (0);
       size = 0;
     }
-    GNUNET_CONTAINER_meta_data_destroy (meta);
-    if (GNUNET_OK !=
-	write_message (GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_META_DATA,
-		       buf,
-		       slen + size))
-      return GNUNET_SYSERR;
   }
-  return GNUNET_OK;
+  GNUNET_CONTAINER_meta_data_destroy (meta);
+  *msize = slen + size;
+  return buf;
+}
+
+
+/**
+ * Extract metadata from files.
+ *
+ * @param item entry we are processing
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on fatal errors
+ */
+static int
+extract_files (struct ScanTreeNode *item)
+{
+  char *buf;
+  size_t msize;
+  int ret;
+
+  if (GNUNET_YES == item->is_directory)
+  {
+    /* for directories, we simply only descent, no extraction, no
+       progress reporting */
+    struct ScanTreeNode *pos;
+
+    for (pos = item->children_head; NULL != pos; pos = pos->next)
+      if (GNUNET_OK !=
+	  extract_files (pos))
+	return GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  buf = build_meta_message (item->filename, plugins, &msize);
+  ret = write_message (GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_META_DATA,
+                       buf,
+                       msize);
+  GNUNET_free (buf);
+  return ret;
+}
+
+
+#if HAVE_LIBEXTRACTOR && HAVE_PTHREAD
+/**
+ * Work item for a parallel extraction worker.
+ */
+struct ExtractJob
+{
+  /**
+   * File to process.
+   */
+  const char *filename;
+
+  /**
+   * Message body for the file, NULL if not yet done.
+   */
+  char *buf;
+
+  /**
+   * Number of bytes in @e buf.
+   */
+  size_t msize;
+};
+
+
+/**
+ * State shared between the extraction workers and the main thread,
+ * which writes the results in the original order.
+ */
+struct ExtractPool
+{
+  /**
+   * All files to process, in the order of the sequential scan.
+   */
+  struct ExtractJob *jobs;
+
+  /**
+   * Number of entries in @e jobs.
+   */
+  unsigned int job_count;
+
+  /**
+   * Index of the next job a worker should take.
+   */
+  unsigned int next_job;
+
+  /**
+   * Index of the next job whose result the main thread writes.
+   */
+  unsigned int next_out;
+
+  /**
+   * Set to #GNUNET_YES if the workers should stop.
+   */
+  int abort;
+
+  /**
+   * Lock protecting this struct.
+   */
+  pthread_mutex_t lock;
+
+  /**
+   * Signalled whenever a job completes or the window advances.
+   */
+  pthread_cond_t cond;
+};
+
+
+/**
+ * Add the files in the given tree to the job array (in the order
+ * in which extract_files() would process them).
+ *
+ * @param item tree to add
+ * @param jobs array to fill (NULL to only count)
+ * @param off current offset in @a jobs, updated
+ */
+static void
+collect_jobs (struct ScanTreeNode *item,
+              struct ExtractJob *jobs,
+              unsigned int *off)
+{
+  struct ScanTreeNode *pos;
+
+  if (GNUNET_YES == item->is_directory)
+  {
+    for (pos = item->children_head; NULL != pos; pos = pos->next)
+      collect_jobs (pos, jobs, off);
+    return;
+  }
+  if (NULL != jobs)
+    jobs[*off].filename = item->filename;
+  (*off)++;
 }
 
 
+/**
+ * Main function of an extraction worker.  Uses its own set of
+ * extractor plugins (plugin lists must not be shared between
+ * threads).
+ *
+ * @param cls the `struct ExtractPool`
+ * @return NULL
+ */
+static void *
+extract_worker (void *cls)
+{
+  struct ExtractPool *pool = cls;
+  struct EXTRACTOR_PluginList *pl;
+  struct ExtractJob *job;
+  char *buf;
+  size_t msize;
+  unsigned int i;
+
+  pl = EXTRACTOR_plugin_add_defaults (EXTRACTOR_OPTION_DEFAULT_POLICY);
+  if (NULL != extractor_config)
+    pl = EXTRACTOR_plugin_add_config (pl, extractor_config,
+                                      EXTRACTOR_OPTION_DEFAULT_POLICY);
+  while (1)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    while ( (GNUNET_YES != pool->abort) &&
+            (pool->next_job < pool->job_count) &&
+            (pool->next_job >= pool->next_out + EXTRACT_WINDOW) )
+      GNUNET_assert (0 == pthread_cond_wait (&pool->cond, &pool->lock));
+    if ( (GNUNET_YES == pool->abort) ||
+         (pool->next_job >= pool->job_count) )
+    {
+      GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+      break;
+    }
+    i = pool->next_job++;
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+    job = &pool->jobs[i];
+    buf = build_meta_message (job->filename, pl, &msize);
+    GNUNET_assert (0 == pthread_mutex_lock (&pool->lock));
+    job->msize = msize;
+    job->buf = buf;
+    GNUNET_assert (0 == pthread_cond_broadcast (&pool->cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool->lock));
+  }
+  EXTRACTOR_plugin_remove_all (pl);
+  return NULL;
+}
+
+
+/**
+ * Extract metadata from files using several worker threads; the
+ * results are written in the same order as by extract_files(), as
+ * the parent matches them against its own view of the tree.
+ *
+ * @param root tree to process
+ * @param num_workers number of worker threads to use
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on fatal errors
+ */
+static int
+extract_files_parallel (struct ScanTreeNode *root,
+                        unsigned int num_workers)
+{
+  struct ExtractPool pool;
+  pthread_t workers[MAX_EXTRACT_THREADS];
+  unsigned int started;
+  unsigned int i;
+  int ret;
+
+  memset (&pool, 0, sizeof (pool));
+  collect_jobs (root, NULL, &pool.job_count);
+  if (0 == pool.job_count)
+    return GNUNET_OK;
+  pool.jobs = GNUNET_malloc (pool.job_count * sizeof (struct ExtractJob));
+  i = 0;
+  collect_jobs (root, pool.jobs, &i);
+  GNUNET_assert (0 == pthread_mutex_init (&pool.lock, NULL));
+  GNUNET_assert (0 == pthread_cond_init (&pool.cond, NULL));
+  started = 0;
+  for (i = 0; i < num_workers; i++)
+  {
+    if (0 != pthread_create (&workers[started], NULL,
+                             &extract_worker, &pool))
+      break;
+    started++;
+  }
+  ret = GNUNET_OK;
+  if (0 == started)
+  {
+    /* could not start any thread, do it ourselves */
+    ret = extract_files (root);
+    pool.next_out = pool.job_count;
+  }
+  while (pool.next_out < pool.job_count)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&pool.lock));
+    while (NULL == pool.jobs[pool.next_out].buf)
+      GNUNET_assert (0 == pthread_cond_wait (&pool.cond, &pool.lock));
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool.lock));
+    ret = write_message (GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_META_DATA,
+                         pool.jobs[pool.next_out].buf,
+                         pool.jobs[pool.next_out].msize);
+    GNUNET_free (pool.jobs[pool.next_out].buf);
+    pool.jobs[pool.next_out].buf = NULL;
+    GNUNET_assert (0 == pthread_mutex_lock (&pool.lock));
+    pool.next_out++;
+    if (GNUNET_OK != ret)
+      pool.abort = GNUNET_YES;
+    GNUNET_assert (0 == pthread_cond_broadcast (&pool.cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&pool.lock));
+    if (GNUNET_OK != ret)
+      break;
+  }
+  for (i = 0; i < started; i++)
+    GNUNET_assert (0 == pthread_join (workers[i], NULL));
+  for (i = 0; i < pool.job_count; i++)
+    GNUNET_free_non_null (pool.jobs[i].buf);
+  GNUNET_free (pool.jobs);
+  GNUNET_assert (0 == pthread_cond_destroy (&pool.cond));
+  GNUNET_assert (0 == pthread_mutex_destroy (&pool.lock));
+  return ret;
+}
+#endif
+
+
 #ifndef WINDOWS
 /**
  * Install a signal handler to ignore SIGPIPE.
@@ -504,6 +766,10 @@ main (int argc,
   const char *filename_expanded;
   const char *ex;
   struct ScanTreeNode *root;
+  int ret;
+#if HAVE_LIBEXTRACTOR && HAVE_PTHREAD
+  long num_workers;
+#endif
 
 #if WINDOWS
   /* We're using stdout to communicate binary data back to the parent; use
@@ -540,6 +806,7 @@ main (int argc,
        (0 != strcmp (ex, "-")) )
   {
 #if HAVE_LIBEXTRACTOR
+    extractor_config = ex;
     plugins = EXTRACTOR_plugin_add_defaults (EXTRACTOR_OPTION_DEFAULT_POLICY);
     if (NULL != ex)
       plugins = EXTRACTOR_plugin_add_config (plugins, ex,
@@ -575,8 +842,20 @@ main (int argc,
   }
   if (NULL != root)
   {
-    if (GNUNET_OK !=
-	extract_files (root))
+    ret = GNUNET_NO;
+#if HAVE_LIBEXTRACTOR && HAVE_PTHREAD
+    /* extraction is CPU-bound (and libextractor runs its plugins in
+       separate processes), so spread it over the available cores */
+    num_workers = sysconf (_SC_NPROCESSORS_ONLN);
+    if ( (NULL != plugins) &&
+         (num_workers > 1) )
+      ret = extract_files_parallel (root,
+                                    (unsigned int) GNUNET_MIN (num_workers,
+                                                               MAX_EXTRACT_THREADS));
+#endif
+    if (GNUNET_NO == ret)
+      ret = extract_files (root);
+    if (GNUNET_OK != ret)
     {
       (void) write_message (GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_ERROR, NULL, 0);
       free_tree (root);
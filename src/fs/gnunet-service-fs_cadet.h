@@ -102,6 +102,12 @@ void
 GSF_cadet_stop_client (void);
 
 
+/**
+ * Maximum number of queries in a `struct CadetQueryBatchMessage`.
+ */
+#define MAX_CADET_QUERY_BATCH 64
+
+
 GNUNET_NETWORK_STRUCT_BEGIN
 
 /**
@@ -128,6 +134,51 @@ struct CadetQueryMessage
 };
 
 
+/**
+ * Entry in a `struct CadetQueryBatchMessage`.
+ */
+struct CadetQueryBatchEntry
+{
+
+  /**
+   * Block type must be DBLOCK or IBLOCK.
+   */
+  uint32_t type GNUNET_PACKED;
+
+  /**
+   * Query hash from CHK (hash of encrypted block).
+   */
+  struct GNUNET_HashCode query;
+
+};
+
+
+/**
+ * Query from one peer, asking the other for several CHK-blocks.
+ * Only sent on channels to the
+ * #GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER_BATCH port; the
+ * replies are ordinary `struct CadetReplyMessage`s, in no
+ * particular order.
+ */
+struct CadetQueryBatchMessage
+{
+
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_FS_CADET_QUERY_BATCH.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of `struct CadetQueryBatchEntry`s that follow,
+   * at most #MAX_CADET_QUERY_BATCH.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /* followed by @e count `struct CadetQueryBatchEntry`s */
+
+};
+
+
 /**
  * Reply to a CadetQueryMessage.
  */
@@ -149,6 +149,23 @@ struct CadetHandle
    */
   struct GNUNET_SCHEDULER_Task * reset_task;
 
+  /**
+   * Number of replies we received on the current channel.
+   */
+  unsigned int replies_received;
+
+  /**
+   * #GNUNET_YES if the current channel goes to the batch transfer
+   * port and we send `struct CadetQueryBatchMessage`s.
+   */
+  int batched;
+
+  /**
+   * #GNUNET_YES if the other peer refused a channel to the batch
+   * transfer port, so we only use the single-query protocol.
+   */
+  int legacy;
+
 };
 
 
@@ -205,6 +222,28 @@ move_to_pending (void *cls,
 }
 
 
+/**
+ * Open the channel to the target of the given cadet handle, using
+ * the batch transfer port unless the peer is known to only speak
+ * the single-query protocol.
+ *
+ * @param mh cadet handle to open the channel for
+ */
+static void
+open_channel (struct CadetHandle *mh)
+{
+  mh->batched = (GNUNET_YES == mh->legacy) ? GNUNET_NO : GNUNET_YES;
+  mh->replies_received = 0;
+  mh->channel = GNUNET_CADET_channel_create (cadet_handle,
+                                             mh,
+                                             &mh->target,
+                                             (GNUNET_YES == mh->batched)
+                                             ? GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER_BATCH
+                                             : GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER,
+                                             GNUNET_CADET_OPTION_RELIABLE);
+}
+
+
 /**
  * We had a serious error, tear down and re-create cadet from scratch.
  *
@@ -233,11 +272,7 @@ reset_cadet (struct CadetHandle *mh)
   GNUNET_CONTAINER_multihashmap_iterate (mh->waiting_map,
 					 &move_to_pending,
 					 mh);
-  mh->channel = GNUNET_CADET_channel_create (cadet_handle,
-					  mh,
-					  &mh->target,
-					  GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER,
-					  GNUNET_CADET_OPTION_RELIABLE);
+  open_channel (mh);
   transmit_pending (mh);
 }
 
@@ -299,6 +334,82 @@ reset_cadet_async (struct CadetHandle *mh)
 }
 
 
+/**
+ * Move a pending request to the waiting map, as we are about to
+ * transmit it.
+ *
+ * @param mh cadet the request is sent on
+ * @param sr the request
+ */
+static void
+mark_transmitted (struct CadetHandle *mh,
+                  struct GSF_CadetRequest *sr)
+{
+  GNUNET_CONTAINER_DLL_remove (mh->pending_head,
+			       mh->pending_tail,
+			       sr);
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_CONTAINER_multihashmap_put (mh->waiting_map,
+						    &sr->query,
+						    sr,
+						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  sr->was_transmitted = GNUNET_YES;
+}
+
+
+/**
+ * Write as many pending queries as fit into @a buf (and at most
+ * #MAX_CADET_QUERY_BATCH) as one batch message.
+ *
+ * @param mh the cadet to transmit on
+ * @param size the number of bytes that can be written to @a buf
+ * @param buf where to write the message
+ * @return number of bytes written to @a buf
+ */
+static size_t
+transmit_batch (struct CadetHandle *mh,
+                size_t size,
+                void *buf)
+{
+  struct CadetQueryBatchMessage *bqm = buf;
+  struct CadetQueryBatchEntry *entries;
+  struct GSF_CadetRequest *sr;
+  unsigned int count;
+  size_t msize;
+
+  if (NULL == mh->pending_head)
+    return 0;
+  GNUNET_assert (size >= sizeof (struct CadetQueryBatchMessage) +
+                 sizeof (struct CadetQueryBatchEntry));
+  entries = (struct CadetQueryBatchEntry *) &bqm[1];
+  count = 0;
+  while ( (NULL != (sr = mh->pending_head)) &&
+          (count < MAX_CADET_QUERY_BATCH) &&
+          (sizeof (struct CadetQueryBatchMessage) +
+           (count + 1) * sizeof (struct CadetQueryBatchEntry) <= size) )
+  {
+    mark_transmitted (mh, sr);
+    entries[count].type = htonl (sr->type);
+    entries[count].query = sr->query;
+    count++;
+  }
+  msize = sizeof (struct CadetQueryBatchMessage) +
+    count * sizeof (struct CadetQueryBatchEntry);
+  bqm->header.size = htons ((uint16_t) msize);
+  bqm->header.type = htons (GNUNET_MESSAGE_TYPE_FS_CADET_QUERY_BATCH);
+  bqm->count = htonl (count);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Sending batch of %u queries via cadet to %s\n",
+	      count,
+	      GNUNET_i2s (&mh->target));
+  GNUNET_STATISTICS_update (GSF_stats,
+			    gettext_noop ("# query batches sent via cadet"), 1,
+			    GNUNET_NO);
+  transmit_pending (mh);
+  return msize;
+}
+
+
 /**
  * Functions of this signature are called whenever we are ready to transmit
  * query via a cadet.
@@ -326,19 +437,13 @@ transmit_sqm (void *cls,
     reset_cadet_async (mh);
     return 0;
   }
+  if (GNUNET_YES == mh->batched)
+    return transmit_batch (mh, size, buf);
   sr = mh->pending_head;
   if (NULL == sr)
     return 0;
   GNUNET_assert (size >= sizeof (struct CadetQueryMessage));
-  GNUNET_CONTAINER_DLL_remove (mh->pending_head,
-			       mh->pending_tail,
-			       sr);
-  GNUNET_assert (GNUNET_OK ==
-		 GNUNET_CONTAINER_multihashmap_put (mh->waiting_map,
-						    &sr->query,
-						    sr,
-						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
-  sr->was_transmitted = GNUNET_YES;
+  mark_transmitted (mh, sr);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Sending query for %s via cadet to %s\n",
 	      GNUNET_h2s (&sr->query),
@@ -365,13 +470,33 @@ transmit_sqm (void *cls,
 static void
 transmit_pending (struct CadetHandle *mh)
 {
+  struct GSF_CadetRequest *sr;
+  unsigned int count;
+  size_t msize;
+
   if (NULL == mh->channel)
     return;
   if (NULL != mh->wh)
     return;
+  if (GNUNET_YES == mh->batched)
+  {
+    count = 0;
+    for (sr = mh->pending_head;
+         (NULL != sr) && (count < MAX_CADET_QUERY_BATCH);
+         sr = sr->next)
+      count++;
+    if (0 == count)
+      return;
+    msize = sizeof (struct CadetQueryBatchMessage) +
+      count * sizeof (struct CadetQueryBatchEntry);
+  }
+  else
+  {
+    msize = sizeof (struct CadetQueryMessage);
+  }
   mh->wh = GNUNET_CADET_notify_transmit_ready (mh->channel, GNUNET_YES /* allow cork */,
 					      GNUNET_TIME_UNIT_FOREVER_REL,
-					      sizeof (struct CadetQueryMessage),
+					      msize,
 					      &transmit_sqm, mh);
 }
 
@@ -490,6 +615,7 @@ reply_cb (void *cls,
 	      GNUNET_h2s (&query),
 	      GNUNET_i2s (&mh->target));
   GNUNET_CADET_receive_done (channel);
+  mh->replies_received++;
   GNUNET_STATISTICS_update (GSF_stats,
 			    gettext_noop ("# replies received via cadet"), 1,
 			    GNUNET_NO);
@@ -548,11 +674,7 @@ get_cadet (const struct GNUNET_PeerIdentity *target)
 						    &mh->target,
 						    mh,
 						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-  mh->channel = GNUNET_CADET_channel_create (cadet_handle,
-                                            mh,
-                                            &mh->target,
-                                            GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER,
-                                            GNUNET_CADET_OPTION_RELIABLE);
+  open_channel (mh);
   GNUNET_assert (mh ==
                  GNUNET_CONTAINER_multipeermap_get (cadet_map,
                                                     target));
@@ -683,6 +805,23 @@ cleaner_cb (void *cls,
     return; /* being destroyed elsewhere */
   GNUNET_assert (channel == mh->channel);
   mh->channel = NULL;
+  if ( (GNUNET_YES == mh->batched) &&
+       (0 == mh->replies_received) )
+  {
+    /* peer may not support the batch port, retry with
+       the single-query protocol */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Batch channel to %s closed without replies, falling back to single queries\n",
+                GNUNET_i2s (&mh->target));
+    mh->legacy = GNUNET_YES;
+    if (NULL != mh->wh)
+    {
+      GNUNET_CADET_notify_transmit_ready_cancel (mh->wh);
+      mh->wh = NULL;
+    }
+    reset_cadet_async (mh);
+    return;
+  }
   while (NULL != (sr = mh->pending_head))
     GSF_cadet_query_cancel (sr);
   /* first remove `mh` from the `cadet_map`, so that if the
@@ -748,6 +887,8 @@ release_cadets (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Timeout on cadet channel to %s\n",
 	      GNUNET_i2s (&mh->target));
+  /* do not fall back to another channel while shutting down */
+  mh->batched = GNUNET_NO;
   if (NULL != mh->channel)
     GNUNET_CADET_channel_destroy (mh->channel);
   return GNUNET_YES;
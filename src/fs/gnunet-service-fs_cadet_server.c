@@ -42,6 +42,48 @@
  */
 #define IDLE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 2)
 
+/**
+ * How many replies may be waiting in the write queue of a client
+ * before we stop reading further query batches from it?
+ */
+#define MAX_WRITE_QUEUE (2 * MAX_CADET_QUERY_BATCH)
+
+/**
+ * How many datastore lookups for query batches do we run at most
+ * in parallel per client?
+ */
+#define MAX_PENDING_LOOKUPS 4
+
+
+struct CadetClient;
+
+
+/**
+ * A datastore lookup for (part of) a query batch.
+ */
+struct PendingLookup
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingLookup *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingLookup *prev;
+
+  /**
+   * Client the lookup is for.
+   */
+  struct CadetClient *sc;
+
+  /**
+   * Active request to the datastore.
+   */
+  struct GNUNET_DATASTORE_QueueEntry *qe;
+};
+
 
 /**
  * A message in the queue to be written to the cadet.
@@ -105,6 +147,16 @@ struct CadetClient
    */
   struct GNUNET_DATASTORE_QueueEntry *qe;
 
+  /**
+   * Head of datastore lookups for query batches.
+   */
+  struct PendingLookup *pl_head;
+
+  /**
+   * Tail of datastore lookups for query batches.
+   */
+  struct PendingLookup *pl_tail;
+
   /**
    * Task that is scheduled to asynchronously terminate the connection.
    */
@@ -120,6 +172,22 @@ struct CadetClient
    */
   size_t reply_size;
 
+  /**
+   * Number of entries in the write queue.
+   */
+  unsigned int wqi_count;
+
+  /**
+   * Number of entries in the pending lookup DLL.
+   */
+  unsigned int pl_count;
+
+  /**
+   * #GNUNET_YES if we received a message and did not yet
+   * call #GNUNET_CADET_receive_done() for it.
+   */
+  int receive_pending;
+
 };
 
 
@@ -190,13 +258,21 @@ refresh_timeout_task (struct CadetClient *sc)
 
 
 /**
- * We're done handling a request from a client, read the next one.
+ * We're done handling a request from a client, read the next one
+ * (unless the client already has too much work queued with us).
  *
  * @param sc client to continue reading requests from
  */
 static void
 continue_reading (struct CadetClient *sc)
 {
+  if (GNUNET_NO == sc->receive_pending)
+    return;
+  if ( (NULL != sc->qe) ||
+       (sc->pl_count >= MAX_PENDING_LOOKUPS) ||
+       (sc->wqi_count >= MAX_WRITE_QUEUE) )
+    return; /* flow control: wait for work to complete */
+  sc->receive_pending = GNUNET_NO;
   refresh_timeout_task (sc);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Finished processing cadet request from client %p, ready to receive the next one\n",
@@ -252,6 +328,7 @@ write_continuation (void *cls,
   GNUNET_CONTAINER_DLL_remove (sc->wqi_head,
 			       sc->wqi_tail,
 			       wqi);
+  sc->wqi_count--;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Transmitted %u byte reply via cadet to %p\n",
 	      (unsigned int) size,
@@ -262,6 +339,7 @@ write_continuation (void *cls,
   memcpy (buf, &wqi[1], ret = wqi->msize);
   GNUNET_free (wqi);
   continue_writing (sc);
+  continue_reading (sc);
   return ret;
 }
 
@@ -307,6 +385,56 @@ continue_writing (struct CadetClient *sc)
 }
 
 
+/**
+ * Append a reply for the given block to the write queue of a client.
+ *
+ * @param sc client to send the reply to
+ * @param key query of the block
+ * @param size number of bytes in @a data
+ * @param data the block
+ * @param type type of the block
+ * @param expiration expiration time for the block
+ */
+static void
+queue_reply (struct CadetClient *sc,
+             const struct GNUNET_HashCode *key,
+             size_t size,
+             const void *data,
+             enum GNUNET_BLOCK_Type type,
+             struct GNUNET_TIME_Absolute expiration)
+{
+  size_t msize = size + sizeof (struct CadetReplyMessage);
+  struct WriteQueueItem *wqi;
+  struct CadetReplyMessage *srm;
+
+  if (msize > GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  GNUNET_break (GNUNET_BLOCK_TYPE_ANY != type);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Starting transmission of %u byte reply of type %d for query `%s' via cadet to %p\n",
+	      (unsigned int) size,
+              (unsigned int) type,
+	      GNUNET_h2s (key),
+	      sc);
+  wqi = GNUNET_malloc (sizeof (struct WriteQueueItem) + msize);
+  wqi->msize = msize;
+  srm = (struct CadetReplyMessage *) &wqi[1];
+  srm->header.size = htons ((uint16_t) msize);
+  srm->header.type = htons (GNUNET_MESSAGE_TYPE_FS_CADET_REPLY);
+  srm->type = htonl (type);
+  srm->expiration = GNUNET_TIME_absolute_hton (expiration);
+  memcpy (&srm[1], data, size);
+  sc->reply_size = msize;
+  GNUNET_CONTAINER_DLL_insert_tail (sc->wqi_head,
+                                    sc->wqi_tail,
+                                    wqi);
+  sc->wqi_count++;
+}
+
+
 /**
  * Process a datum that was stored in the datastore.
  *
@@ -333,9 +461,6 @@ handle_datastore_reply (void *cls,
                         uint64_t uid)
 {
   struct CadetClient *sc = cls;
-  size_t msize = size + sizeof (struct CadetReplyMessage);
-  struct WriteQueueItem *wqi;
-  struct CadetReplyMessage *srm;
 
   sc->qe = NULL;
   if (NULL == data)
@@ -382,31 +507,7 @@ handle_datastore_reply (void *cls,
     }
     return;
   }
-  if (msize > GNUNET_SERVER_MAX_MESSAGE_SIZE)
-  {
-    GNUNET_break (0);
-    continue_writing (sc);
-    return;
-  }
-  GNUNET_break (GNUNET_BLOCK_TYPE_ANY != type);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Starting transmission of %u byte reply of type %d for query `%s' via cadet to %p\n",
-	      (unsigned int) size,
-              (unsigned int) type,
-	      GNUNET_h2s (key),
-	      sc);
-  wqi = GNUNET_malloc (sizeof (struct WriteQueueItem) + msize);
-  wqi->msize = msize;
-  srm = (struct CadetReplyMessage *) &wqi[1];
-  srm->header.size = htons ((uint16_t) msize);
-  srm->header.type = htons (GNUNET_MESSAGE_TYPE_FS_CADET_REPLY);
-  srm->type = htonl (type);
-  srm->expiration = GNUNET_TIME_absolute_hton (expiration);
-  memcpy (&srm[1], data, size);
-  sc->reply_size = msize;
-  GNUNET_CONTAINER_DLL_insert (sc->wqi_head,
-			       sc->wqi_tail,
-			       wqi);
+  queue_reply (sc, key, size, data, type, expiration);
   continue_writing (sc);
 }
 
@@ -433,6 +534,7 @@ request_cb (void *cls,
   const struct CadetQueryMessage *sqm;
 
   sqm = (const struct CadetQueryMessage *) message;
+  sc->receive_pending = GNUNET_YES;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received query for `%s' via cadet from client %p\n",
 	      GNUNET_h2s (&sqm->query),
@@ -459,6 +561,168 @@ request_cb (void *cls,
 }
 
 
+/**
+ * Process a datum found for a query batch.
+ *
+ * @param cls closure with the `struct PendingLookup`
+ * @param key key for the content, NULL at the end of the lookup
+ * @param size number of bytes in @a data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param expiration expiration time for the content
+ * @param uid unique identifier for the datum;
+ *        maybe 0 if no unique identifier is available
+ */
+static void
+handle_batch_datastore_reply (void *cls,
+                              const struct GNUNET_HashCode *key,
+                              size_t size,
+                              const void *data,
+                              enum GNUNET_BLOCK_Type type,
+                              uint32_t priority,
+                              uint32_t anonymity,
+                              struct GNUNET_TIME_Absolute expiration,
+                              uint64_t uid)
+{
+  struct PendingLookup *pl = cls;
+  struct CadetClient *sc = pl->sc;
+
+  if (NULL == key)
+  {
+    GNUNET_CONTAINER_DLL_remove (sc->pl_head,
+                                 sc->pl_tail,
+                                 pl);
+    sc->pl_count--;
+    GNUNET_free (pl);
+    continue_writing (sc);
+    continue_reading (sc);
+    return;
+  }
+  if (GNUNET_BLOCK_TYPE_FS_ONDEMAND == type)
+  {
+    /* on-demand encoding calls us back synchronously with
+       the encoded block (with the same closure) */
+    if (GNUNET_OK !=
+        GNUNET_FS_handle_on_demand_block (key,
+                                          size, data, type,
+                                          priority, anonymity,
+                                          expiration, uid,
+                                          &handle_batch_datastore_reply,
+                                          pl))
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "On-demand encoding request failed\n");
+    return;
+  }
+  queue_reply (sc, key, size, data, type, expiration);
+  continue_writing (sc);
+}
+
+
+/**
+ * Functions with this signature are called whenever a
+ * complete query batch message is received.  Looks up all
+ * queries of the same type with a single datastore request and
+ * streams the replies back as they are found.
+ *
+ * @param cls closure with the `struct CadetClient`
+ * @param channel channel handle
+ * @param channel_ctx channel context
+ * @param message the actual message
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR to stop further processing
+ */
+static int
+request_batch_cb (void *cls,
+                  struct GNUNET_CADET_Channel *channel,
+                  void **channel_ctx,
+                  const struct GNUNET_MessageHeader *message)
+{
+  struct CadetClient *sc = *channel_ctx;
+  const struct CadetQueryBatchMessage *bqm;
+  const struct CadetQueryBatchEntry *entries;
+  struct GNUNET_HashCode keys[MAX_CADET_QUERY_BATCH];
+  int done[MAX_CADET_QUERY_BATCH];
+  struct PendingLookup *pl;
+  uint32_t count;
+  uint32_t type;
+  unsigned int i;
+  unsigned int j;
+  unsigned int key_count;
+  uint16_t msize;
+
+  msize = ntohs (message->size);
+  if (msize < sizeof (struct CadetQueryBatchMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  bqm = (const struct CadetQueryBatchMessage *) message;
+  count = ntohl (bqm->count);
+  if ( (0 == count) ||
+       (count > MAX_CADET_QUERY_BATCH) ||
+       (msize != sizeof (struct CadetQueryBatchMessage) +
+        count * sizeof (struct CadetQueryBatchEntry)) )
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  sc->receive_pending = GNUNET_YES;
+  entries = (const struct CadetQueryBatchEntry *) &bqm[1];
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Received batch of %u queries via cadet from client %p\n",
+	      (unsigned int) count,
+	      sc);
+  GNUNET_STATISTICS_update (GSF_stats,
+			    gettext_noop ("# queries received via cadet"),
+                            count,
+			    GNUNET_NO);
+  refresh_timeout_task (sc);
+  memset (done, 0, sizeof (done));
+  for (i = 0; i < count; i++)
+  {
+    if (done[i])
+      continue;
+    /* one datastore lookup per distinct block type */
+    type = ntohl (entries[i].type);
+    key_count = 0;
+    for (j = i; j < count; j++)
+    {
+      if ( (done[j]) ||
+           (type != ntohl (entries[j].type)) )
+        continue;
+      done[j] = GNUNET_YES;
+      keys[key_count++] = entries[j].query;
+    }
+    pl = GNUNET_new (struct PendingLookup);
+    pl->sc = sc;
+    pl->qe = GNUNET_DATASTORE_get_keys_multi (GSF_dsh,
+                                              keys,
+                                              key_count,
+                                              (enum GNUNET_BLOCK_Type) type,
+                                              0 /* priority */,
+                                              GSF_datastore_queue_size,
+                                              GNUNET_TIME_UNIT_FOREVER_REL,
+                                              &handle_batch_datastore_reply,
+                                              pl);
+    if (NULL == pl->qe)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Queueing request with datastore failed (queue full?)\n");
+      GNUNET_free (pl);
+      continue;
+    }
+    GNUNET_CONTAINER_DLL_insert (sc->pl_head,
+                                 sc->pl_tail,
+                                 pl);
+    sc->pl_count++;
+  }
+  continue_writing (sc);
+  continue_reading (sc);
+  return GNUNET_OK;
+}
+
+
 /**
  * Functions of this type are called upon new cadet connection from other peers.
  *
@@ -520,6 +784,7 @@ cleaner_cb (void *cls,
 {
   struct CadetClient *sc = channel_ctx;
   struct WriteQueueItem *wqi;
+  struct PendingLookup *pl;
 
   if (NULL == sc)
     return;
@@ -538,6 +803,14 @@ cleaner_cb (void *cls,
     GNUNET_CADET_notify_transmit_ready_cancel (sc->wh);
   if (NULL != sc->qe)
     GNUNET_DATASTORE_cancel (sc->qe);
+  while (NULL != (pl = sc->pl_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (sc->pl_head,
+                                 sc->pl_tail,
+                                 pl);
+    GNUNET_DATASTORE_cancel (pl->qe);
+    GNUNET_free (pl);
+  }
   while (NULL != (wqi = sc->wqi_head))
   {
     GNUNET_CONTAINER_DLL_remove (sc->wqi_head,
@@ -561,10 +834,12 @@ GSF_cadet_start_server ()
 {
   static const struct GNUNET_CADET_MessageHandler handlers[] = {
     { &request_cb, GNUNET_MESSAGE_TYPE_FS_CADET_QUERY, sizeof (struct CadetQueryMessage)},
+    { &request_batch_cb, GNUNET_MESSAGE_TYPE_FS_CADET_QUERY_BATCH, 0},
     { NULL, 0, 0 }
   };
   static const uint32_t ports[] = {
     GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER,
+    GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER_BATCH,
     0
   };
 
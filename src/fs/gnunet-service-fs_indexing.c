@@ -35,6 +35,69 @@
 #include "gnunet-service-fs_indexing.h"
 #include "fs.h"
 
+/**
+ * Maximum number of indexed files we keep open at the same time.
+ */
+#define MAX_OPEN_FILES 32
+
+/**
+ * Maximum number of encrypted on-demand blocks we keep in memory
+ * (each takes up to #DBLOCK_SIZE bytes).
+ */
+#define MAX_CACHED_BLOCKS 256
+
+/**
+ * How many blocks ahead do we ask the OS to read when we
+ * detect sequential access to an indexed file?
+ */
+#define READAHEAD_BLOCKS 16
+
+/**
+ * Minimum number of journal records before we rewrite the full
+ * index list (we also wait until the journal is at least as long
+ * as the index list itself).
+ */
+#define JOURNAL_COMPACT_MIN 1024
+
+/**
+ * Journal record type: file was added to the index.
+ */
+#define JOURNAL_OP_ADD 1
+
+/**
+ * Journal record type: file was removed from the index.
+ */
+#define JOURNAL_OP_REMOVE 2
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a record in the index list journal; for additions,
+ * followed by @e name_len bytes of the file name (without 0-termination).
+ */
+struct IndexJournalRecord
+{
+
+  /**
+   * #JOURNAL_OP_ADD or #JOURNAL_OP_REMOVE, in NBO.
+   */
+  uint32_t op GNUNET_PACKED;
+
+  /**
+   * Length of the file name following the record, in NBO.
+   */
+  uint32_t name_len GNUNET_PACKED;
+
+  /**
+   * Hash of the contents of the file.
+   */
+  struct GNUNET_HashCode file_id;
+
+};
+
+GNUNET_NETWORK_STRUCT_END
+
 /**
  * In-memory information about indexed files (also available
  * on-disk).
@@ -74,6 +137,61 @@ struct IndexInfo
    */
   struct GNUNET_HashCode file_id;
 
+  /**
+   * This is a doubly linked list (LRU list of open files).
+   */
+  struct IndexInfo *next_open;
+
+  /**
+   * This is a doubly linked list (LRU list of open files).
+   */
+  struct IndexInfo *prev_open;
+
+  /**
+   * Handle of the file if we currently keep it open, otherwise NULL.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Offset right after the block we read last; used to detect
+   * sequential access.
+   */
+  uint64_t next_off;
+
+};
+
+
+/**
+ * Encrypted on-demand block kept in memory.
+ */
+struct CachedBlock
+{
+
+  /**
+   * This is a doubly linked list (LRU order, most recent first).
+   */
+  struct CachedBlock *next;
+
+  /**
+   * This is a doubly linked list (LRU order, most recent first).
+   */
+  struct CachedBlock *prev;
+
+  /**
+   * Query of the block (key in the #block_cache).
+   */
+  struct GNUNET_HashCode query;
+
+  /**
+   * Hash of the indexed file the block was read from.
+   */
+  struct GNUNET_HashCode file_id;
+
+  /**
+   * Number of bytes of encrypted data following this struct.
+   */
+  size_t size;
+
 };
 
 
@@ -94,6 +212,47 @@ static struct IndexInfo *indexed_files_tail;
  */
 static struct GNUNET_CONTAINER_MultiHashMap *ifm;
 
+/**
+ * Head of the LRU list of indexed files we keep open.
+ */
+static struct IndexInfo *open_files_head;
+
+/**
+ * Tail of the LRU list of indexed files we keep open.
+ */
+static struct IndexInfo *open_files_tail;
+
+/**
+ * Number of entries in the open files list.
+ */
+static unsigned int open_files_count;
+
+/**
+ * Maps queries to `struct CachedBlock` entries.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *block_cache;
+
+/**
+ * Head of the LRU list of cached blocks.
+ */
+static struct CachedBlock *cache_head;
+
+/**
+ * Tail of the LRU list of cached blocks.
+ */
+static struct CachedBlock *cache_tail;
+
+/**
+ * Journal of changes to the index list (opened for appending),
+ * NULL if unavailable.
+ */
+static struct GNUNET_DISK_FileHandle *journal_fh;
+
+/**
+ * Number of records in the journal.
+ */
+static unsigned int journal_records;
+
 /**
  * Our configuration.
  */
@@ -106,6 +265,125 @@ static const struct GNUNET_CONFIGURATION_Handle *cfg;
 static struct GNUNET_DATASTORE_Handle *dsh;
 
 
+/**
+ * Close the file handle of the given indexed file (if open).
+ *
+ * @param ii indexed file to close
+ */
+static void
+close_indexed_file (struct IndexInfo *ii)
+{
+  if (NULL == ii->fh)
+    return;
+  GNUNET_CONTAINER_MDLL_remove (open, open_files_head, open_files_tail, ii);
+  open_files_count--;
+  GNUNET_DISK_file_close (ii->fh);
+  ii->fh = NULL;
+}
+
+
+/**
+ * Get an open file handle for the given indexed file, opening the
+ * file if necessary (and closing the least recently used file if
+ * too many are open).
+ *
+ * @param ii indexed file
+ * @return file handle, NULL on error
+ */
+static struct GNUNET_DISK_FileHandle *
+get_indexed_file (struct IndexInfo *ii)
+{
+  if (NULL != ii->fh)
+  {
+    /* move to the front of the LRU list */
+    GNUNET_CONTAINER_MDLL_remove (open, open_files_head, open_files_tail, ii);
+    GNUNET_CONTAINER_MDLL_insert (open, open_files_head, open_files_tail, ii);
+    return ii->fh;
+  }
+  ii->fh = GNUNET_DISK_file_open (ii->filename, GNUNET_DISK_OPEN_READ,
+                                  GNUNET_DISK_PERM_NONE);
+  if (NULL == ii->fh)
+    return NULL;
+  if (open_files_count >= MAX_OPEN_FILES)
+    close_indexed_file (open_files_tail);
+  GNUNET_CONTAINER_MDLL_insert (open, open_files_head, open_files_tail, ii);
+  open_files_count++;
+  ii->next_off = UINT64_MAX;
+  return ii->fh;
+}
+
+
+/**
+ * Remove the given block from the cache.
+ *
+ * @param cb block to remove
+ */
+static void
+drop_cached_block (struct CachedBlock *cb)
+{
+  GNUNET_CONTAINER_DLL_remove (cache_head, cache_tail, cb);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (block_cache,
+                                                       &cb->query, cb));
+  GNUNET_free (cb);
+}
+
+
+/**
+ * Forget everything we cached or opened for the given indexed file.
+ *
+ * @param ii indexed file that is going away
+ */
+static void
+forget_indexed_file (struct IndexInfo *ii)
+{
+  struct CachedBlock *cb;
+  struct CachedBlock *next;
+
+  close_indexed_file (ii);
+  for (cb = cache_head; NULL != cb; cb = next)
+  {
+    next = cb->next;
+    if (0 == memcmp (&cb->file_id, &ii->file_id,
+                     sizeof (struct GNUNET_HashCode)))
+      drop_cached_block (cb);
+  }
+}
+
+
+/**
+ * Add an encrypted block to the cache, evicting the least
+ * recently used block if the cache is full.
+ *
+ * @param query query for the block
+ * @param file_id indexed file the block is from
+ * @param size number of bytes in @a edata
+ * @param edata encrypted block
+ */
+static void
+cache_block (const struct GNUNET_HashCode *query,
+             const struct GNUNET_HashCode *file_id,
+             size_t size,
+             const void *edata)
+{
+  struct CachedBlock *cb;
+
+  if (NULL != GNUNET_CONTAINER_multihashmap_get (block_cache, query))
+    return;
+  if (GNUNET_CONTAINER_multihashmap_size (block_cache) >= MAX_CACHED_BLOCKS)
+    drop_cached_block (cache_tail);
+  cb = GNUNET_malloc (sizeof (struct CachedBlock) + size);
+  cb->query = *query;
+  cb->file_id = *file_id;
+  cb->size = size;
+  memcpy (&cb[1], edata, size);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (block_cache, &cb->query, cb,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  GNUNET_CONTAINER_DLL_insert (cache_head, cache_tail, cb);
+}
+
+
 /**
  * Write the current index information list to disk.
  */
@@ -147,6 +425,40 @@ write_index_list ()
 }
 
 
+/**
+ * Add an entry for an indexed file read from disk (unless we
+ * already have an entry for this hash).
+ *
+ * @param file_id hash of the file
+ * @param fname name of the file
+ */
+static void
+add_index_entry (const struct GNUNET_HashCode *file_id,
+                 const char *fname)
+{
+  struct IndexInfo *pos;
+  size_t slen;
+
+  slen = strlen (fname) + 1;
+  pos = GNUNET_malloc (sizeof (struct IndexInfo) + slen);
+  pos->file_id = *file_id;
+  pos->filename = (const char *) &pos[1];
+  memcpy (&pos[1], fname, slen);
+  if (GNUNET_SYSERR ==
+      GNUNET_CONTAINER_multihashmap_put (ifm, &pos->file_id, pos,
+                                         GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
+  {
+    GNUNET_free (pos);
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_insert (indexed_files_head,
+                                 indexed_files_tail,
+                                 pos);
+  }
+}
+
+
 /**
  * Read index information from disk.
  */
@@ -155,10 +467,8 @@ read_index_list ()
 {
   struct GNUNET_BIO_ReadHandle *rh;
   char *fn;
-  struct IndexInfo *pos;
   char *fname;
   struct GNUNET_HashCode hc;
-  size_t slen;
   char *emsg;
 
   if (GNUNET_OK !=
@@ -189,23 +499,7 @@ read_index_list ()
           GNUNET_BIO_read_string (rh, "Name of indexed file", &fname,
                                   1024 * 16)) && (fname != NULL))
   {
-    slen = strlen (fname) + 1;
-    pos = GNUNET_malloc (sizeof (struct IndexInfo) + slen);
-    pos->file_id = hc;
-    pos->filename = (const char *) &pos[1];
-    memcpy (&pos[1], fname, slen);
-    if (GNUNET_SYSERR ==
-        GNUNET_CONTAINER_multihashmap_put (ifm, &pos->file_id, pos,
-                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-    {
-      GNUNET_free (pos);
-    }
-    else
-    {
-      GNUNET_CONTAINER_DLL_insert (indexed_files_head,
-				   indexed_files_tail,
-				   pos);
-    }
+    add_index_entry (&hc, fname);
     GNUNET_free (fname);
   }
   if (GNUNET_OK != GNUNET_BIO_read_close (rh, &emsg))
@@ -214,6 +508,187 @@ read_index_list ()
 }
 
 
+/**
+ * Get the name of the journal file that records changes to the
+ * index list since it was last written in full.
+ *
+ * @return name of the journal file (caller must free), NULL on error
+ */
+static char *
+get_journal_filename ()
+{
+  char *fn;
+  char *jfn;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg, "FS", "INDEXDB", &fn))
+    return NULL;
+  GNUNET_asprintf (&jfn, "%s.journal", fn);
+  GNUNET_free (fn);
+  return jfn;
+}
+
+
+/**
+ * Open the journal for appending.
+ *
+ * @param truncate #GNUNET_YES to discard the existing journal
+ */
+static void
+open_journal (int truncate)
+{
+  char *jfn;
+  enum GNUNET_DISK_OpenFlags flags;
+
+  if (NULL != journal_fh)
+  {
+    GNUNET_DISK_file_close (journal_fh);
+    journal_fh = NULL;
+  }
+  if (NULL == (jfn = get_journal_filename ()))
+    return;
+  flags = GNUNET_DISK_OPEN_WRITE | GNUNET_DISK_OPEN_CREATE
+    | GNUNET_DISK_OPEN_APPEND;
+  if (GNUNET_YES == truncate)
+    flags |= GNUNET_DISK_OPEN_TRUNCATE;
+  journal_fh = GNUNET_DISK_file_open (jfn, flags,
+                                      GNUNET_DISK_PERM_USER_READ |
+                                      GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == journal_fh)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
+                _("Could not open `%s'.\n"), jfn);
+  GNUNET_free (jfn);
+}
+
+
+/**
+ * Write the full index list and start a new, empty journal.
+ */
+static void
+compact_index_list ()
+{
+  write_index_list ();
+  open_journal (GNUNET_YES);
+  journal_records = 0;
+}
+
+
+/**
+ * Record that a file was added to or removed from the index.  The
+ * change is appended to the journal; once the journal has grown
+ * large relative to the index list, the full list is rewritten.
+ *
+ * @param op #JOURNAL_OP_ADD or #JOURNAL_OP_REMOVE
+ * @param file_id hash of the file
+ * @param filename name of the file (ignored for removals)
+ */
+static void
+journal_index_change (uint32_t op,
+                      const struct GNUNET_HashCode *file_id,
+                      const char *filename)
+{
+  struct IndexJournalRecord *rec;
+  size_t nlen;
+  size_t rsize;
+
+  nlen = (JOURNAL_OP_ADD == op) ? strlen (filename) : 0;
+  rsize = sizeof (struct IndexJournalRecord) + nlen;
+  rec = GNUNET_malloc (rsize);
+  rec->op = htonl (op);
+  rec->name_len = htonl ((uint32_t) nlen);
+  rec->file_id = *file_id;
+  if (0 < nlen)
+    memcpy (&rec[1], filename, nlen);
+  if ( (NULL == journal_fh) ||
+       (rsize != GNUNET_DISK_file_write (journal_fh, rec, rsize)) )
+  {
+    /* journal unusable, fall back to writing everything */
+    GNUNET_free (rec);
+    compact_index_list ();
+    return;
+  }
+  GNUNET_free (rec);
+  journal_records++;
+  if (journal_records >
+      GNUNET_MAX (JOURNAL_COMPACT_MIN,
+                  GNUNET_CONTAINER_multihashmap_size (ifm)))
+    compact_index_list ();
+}
+
+
+/**
+ * Replay the journal on top of the index list read from disk.  If
+ * the journal contained any changes, the full list is rewritten
+ * (which also drops a partially written trailing record).
+ */
+static void
+replay_journal ()
+{
+  struct GNUNET_BIO_ReadHandle *rh;
+  struct IndexJournalRecord rec;
+  struct IndexInfo *pos;
+  char *jfn;
+  char *fname;
+  char *emsg;
+  uint32_t nlen;
+  unsigned int replayed;
+
+  replayed = 0;
+  if (NULL == (jfn = get_journal_filename ()))
+    return;
+  if ( (GNUNET_YES == GNUNET_DISK_file_test (jfn)) &&
+       (NULL != (rh = GNUNET_BIO_read_open (jfn))) )
+  {
+    while (GNUNET_OK ==
+           GNUNET_BIO_read (rh, "Index journal record", &rec, sizeof (rec)))
+    {
+      nlen = ntohl (rec.name_len);
+      if (JOURNAL_OP_REMOVE == ntohl (rec.op))
+      {
+        pos = GNUNET_CONTAINER_multihashmap_get (ifm, &rec.file_id);
+        if (NULL != pos)
+        {
+          GNUNET_CONTAINER_DLL_remove (indexed_files_head,
+                                       indexed_files_tail,
+                                       pos);
+          GNUNET_break (GNUNET_OK ==
+                        GNUNET_CONTAINER_multihashmap_remove (ifm,
+                                                              &pos->file_id,
+                                                              pos));
+          GNUNET_free (pos);
+        }
+        replayed++;
+        continue;
+      }
+      if ( (JOURNAL_OP_ADD != ntohl (rec.op)) ||
+           (0 == nlen) ||
+           (nlen > 1024 * 16) )
+      {
+        GNUNET_break_op (0);
+        break;
+      }
+      fname = GNUNET_malloc (nlen + 1);
+      if (GNUNET_OK !=
+          GNUNET_BIO_read (rh, "Name of indexed file", fname, nlen))
+      {
+        GNUNET_free (fname);
+        break;
+      }
+      add_index_entry (&rec.file_id, fname);
+      GNUNET_free (fname);
+      replayed++;
+    }
+    if (GNUNET_OK != GNUNET_BIO_read_close (rh, &emsg))
+      GNUNET_free (emsg);
+  }
+  GNUNET_free (jfn);
+  if (replayed > 0)
+    compact_index_list ();
+  else
+    open_journal (GNUNET_NO);
+}
+
+
 /**
  * We've validated the hash of the file we're about to index.  Signal
  * success to the client and update our internal data structures.
@@ -246,7 +721,7 @@ signal_index_ok (struct IndexInfo *ii)
   GNUNET_CONTAINER_DLL_insert (indexed_files_head,
 			       indexed_files_tail,
 			       ii);
-  write_index_list ();
+  journal_index_change (JOURNAL_OP_ADD, &ii->file_id, ii->filename);
   GNUNET_SERVER_transmit_context_append_data (ii->tc, NULL, 0,
                                               GNUNET_MESSAGE_TYPE_FS_INDEX_START_OK);
   GNUNET_SERVER_transmit_context_run (ii->tc, GNUNET_TIME_UNIT_MINUTES);
@@ -356,8 +831,9 @@ GNUNET_FS_handle_index_start (void *cls, struct GNUNET_SERVER_Client *client,
               (unsigned int) dev, (unsigned int) mydev);
   /* slow validation, need to hash full file (again) */
   ii->fhc =
-      GNUNET_CRYPTO_hash_file (GNUNET_SCHEDULER_PRIORITY_IDLE, fn,
-                               HASHING_BLOCKSIZE, &hash_for_index_val, ii);
+      GNUNET_CRYPTO_hash_file_offload (fn,
+                                       HASHING_BLOCKSIZE,
+                                       &hash_for_index_val, ii);
   if (ii->fhc == NULL)
     hash_for_index_val (ii, NULL);
   GNUNET_free (fn);
@@ -431,26 +907,24 @@ GNUNET_FS_handle_unindex (void *cls, struct GNUNET_SERVER_Client *client,
     return;
   }
   found = GNUNET_NO;
-  for (pos = indexed_files_head; NULL != pos; pos = pos->next)
+  pos = GNUNET_CONTAINER_multihashmap_get (ifm, &um->file_id);
+  if (NULL != pos)
   {
-    if (0 == memcmp (&pos->file_id, &um->file_id, sizeof (struct GNUNET_HashCode)))
-    {
-      GNUNET_CONTAINER_DLL_remove (indexed_files_head,
-				   indexed_files_tail,
-				   pos);
-      GNUNET_break (GNUNET_OK ==
-                    GNUNET_CONTAINER_multihashmap_remove (ifm, &pos->file_id,
-							  pos));
-      GNUNET_free (pos);
-      found = GNUNET_YES;
-      break;
-    }
+    GNUNET_CONTAINER_DLL_remove (indexed_files_head,
+                                 indexed_files_tail,
+                                 pos);
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_CONTAINER_multihashmap_remove (ifm, &pos->file_id,
+                                                        pos));
+    forget_indexed_file (pos);
+    GNUNET_free (pos);
+    found = GNUNET_YES;
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Client requested unindexing of file `%s': %s\n",
               GNUNET_h2s (&um->file_id), found ? "found" : "not found");
   if (GNUNET_YES == found)
-    write_index_list ();
+    journal_index_change (JOURNAL_OP_REMOVE, &um->file_id, NULL);
   tc = GNUNET_SERVER_transmit_context_create (client);
   GNUNET_SERVER_transmit_context_append_data (tc, NULL, 0,
                                               GNUNET_MESSAGE_TYPE_FS_UNINDEX_OK);
@@ -518,6 +992,7 @@ GNUNET_FS_handle_on_demand_block (const struct GNUNET_HashCode * key, uint32_t s
   struct GNUNET_DISK_FileHandle *fh;
   uint64_t off;
   struct IndexInfo *ii;
+  struct CachedBlock *cb;
 
   if (size != sizeof (struct OnDemandBlock))
   {
@@ -534,6 +1009,20 @@ GNUNET_FS_handle_on_demand_block (const struct GNUNET_HashCode * key, uint32_t s
     GNUNET_break (0);
     return GNUNET_SYSERR;
   }
+  cb = GNUNET_CONTAINER_multihashmap_get (block_cache, key);
+  if (NULL != cb)
+  {
+    /* the cached block was verified against the query when it was
+       read, so we can serve it without touching the disk */
+    GNUNET_CONTAINER_DLL_remove (cache_head, cache_tail, cb);
+    GNUNET_CONTAINER_DLL_insert (cache_head, cache_tail, cb);
+    GNUNET_STATISTICS_update (GSF_stats,
+                              gettext_noop ("# on-demand blocks served from cache"),
+                              1, GNUNET_NO);
+    cont (cont_cls, key, cb->size, &cb[1], GNUNET_BLOCK_TYPE_FS_DBLOCK,
+          priority, anonymity, expiration, uid);
+    return GNUNET_OK;
+  }
   fn = ii->filename;
   if ((NULL == fn) || (0 != ACCESS (fn, R_OK)))
   {
@@ -545,10 +1034,7 @@ GNUNET_FS_handle_on_demand_block (const struct GNUNET_HashCode * key, uint32_t s
                              GNUNET_TIME_UNIT_FOREVER_REL, &remove_cont, NULL);
     return GNUNET_SYSERR;
   }
-  if ((NULL ==
-       (fh =
-        GNUNET_DISK_file_open (fn, GNUNET_DISK_OPEN_READ,
-                               GNUNET_DISK_PERM_NONE))) ||
+  if ((NULL == (fh = get_indexed_file (ii))) ||
       (off != GNUNET_DISK_file_seek (fh, off, GNUNET_DISK_SEEK_SET)) ||
       (-1 == (nsize = GNUNET_DISK_file_read (fh, ndata, sizeof (ndata)))))
   {
@@ -557,13 +1043,19 @@ GNUNET_FS_handle_on_demand_block (const struct GNUNET_HashCode * key, uint32_t s
                 ("Could not access indexed file `%s' (%s) at offset %llu: %s\n"),
                 GNUNET_h2s (&odb->file_id), fn, (unsigned long long) off,
                 (fn == NULL) ? _("not indexed") : STRERROR (errno));
-    if (fh != NULL)
-      GNUNET_DISK_file_close (fh);
+    close_indexed_file (ii);
     GNUNET_DATASTORE_remove (dsh, key, size, data, -1, -1,
                              GNUNET_TIME_UNIT_FOREVER_REL, &remove_cont, NULL);
     return GNUNET_SYSERR;
   }
-  GNUNET_DISK_file_close (fh);
+#if HAVE_POSIX_FADVISE && defined(POSIX_FADV_WILLNEED) && !WINDOWS
+  /* sequential access, ask the OS to read the following blocks */
+  if (off == ii->next_off)
+    (void) posix_fadvise (fh->fd, off + nsize,
+                          READAHEAD_BLOCKS * DBLOCK_SIZE,
+                          POSIX_FADV_WILLNEED);
+#endif
+  ii->next_off = off + nsize;
   GNUNET_CRYPTO_hash (ndata, nsize, &nkey);
   GNUNET_CRYPTO_hash_to_aes_key (&nkey, &skey, &iv);
   GNUNET_CRYPTO_symmetric_encrypt (ndata, nsize, &skey, &iv, edata);
@@ -573,12 +1065,14 @@ GNUNET_FS_handle_on_demand_block (const struct GNUNET_HashCode * key, uint32_t s
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
                 _("Indexed file `%s' changed at offset %llu\n"), fn,
                 (unsigned long long) off);
+    close_indexed_file (ii);
     GNUNET_DATASTORE_remove (dsh, key, size, data, -1, -1,
                              GNUNET_TIME_UNIT_FOREVER_REL, &remove_cont, NULL);
     return GNUNET_SYSERR;
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "On-demand encoded block for query `%s'\n", GNUNET_h2s (key));
+  cache_block (key, &odb->file_id, nsize, edata);
   cont (cont_cls, key, nsize, edata, GNUNET_BLOCK_TYPE_FS_DBLOCK, priority,
         anonymity, expiration, uid);
   return GNUNET_OK;
@@ -603,10 +1097,20 @@ GNUNET_FS_indexing_done ()
     GNUNET_break (GNUNET_OK ==
 		  GNUNET_CONTAINER_multihashmap_remove (ifm,
 							&pos->file_id, pos));
+    close_indexed_file (pos);
     GNUNET_free (pos);
   }
   GNUNET_CONTAINER_multihashmap_destroy (ifm);
   ifm = NULL;
+  while (NULL != cache_head)
+    drop_cached_block (cache_head);
+  GNUNET_CONTAINER_multihashmap_destroy (block_cache);
+  block_cache = NULL;
+  if (NULL != journal_fh)
+  {
+    GNUNET_DISK_file_close (journal_fh);
+    journal_fh = NULL;
+  }
   cfg = NULL;
 }
 
@@ -624,7 +1128,10 @@ GNUNET_FS_indexing_init (const struct GNUNET_CONFIGURATION_Handle *c,
   cfg = c;
   dsh = d;
   ifm = GNUNET_CONTAINER_multihashmap_create (128, GNUNET_YES);
+  block_cache = GNUNET_CONTAINER_multihashmap_create (MAX_CACHED_BLOCKS,
+                                                      GNUNET_YES);
   read_index_list ();
+  replay_journal ();
   return GNUNET_OK;
 }
 
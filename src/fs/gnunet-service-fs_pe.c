@@ -34,6 +34,37 @@
  */
 #define INSANE_STATISTICS GNUNET_NO
 
+/**
+ * By how much do we delay the first transmission of a request to a
+ * peer that answers slower than average at most?
+ */
+#define MAX_SOURCE_STAGGER GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 500)
+
+/**
+ * Maximum number of queries we pack into a single core transmission
+ * in token bucket mode.
+ */
+#define QUERY_BATCH_SIZE 16
+
+/**
+ * Maximum number of bytes we ask core for when packing several
+ * queries into one transmission (a single query that is larger is
+ * still sent on its own).
+ */
+#define QUERY_BATCH_MAX_BYTES (8 * 1024)
+
+/**
+ * Query rate (queries per second) we assume for a peer that has not
+ * answered any of our queries yet; also used as the lower bound.
+ */
+#define MIN_QUERY_RATE 4.0
+
+/**
+ * Upper bound for the query rate (queries per second) towards a
+ * single peer.
+ */
+#define MAX_QUERY_RATE 1024.0
+
 /**
  * List of GSF_PendingRequests this request plan
  * participates with.
@@ -197,6 +228,17 @@ struct PeerPlan
    * Current task for executing the plan.
    */
   struct GNUNET_SCHEDULER_Task * task;
+
+  /**
+   * Time at which we last refilled the token bucket.
+   */
+  struct GNUNET_TIME_Absolute bucket_update;
+
+  /**
+   * Number of queries we may currently send to this peer
+   * (token bucket mode only).
+   */
+  double tokens;
 };
 
 
@@ -215,6 +257,12 @@ static unsigned long long total_delay;
  */
 static unsigned long long plan_count;
 
+/**
+ * Do we schedule queries using per-peer token buckets and batched
+ * transmissions (option "QUERY_TOKEN_BUCKETS")?
+ */
+static int token_bucket_mode;
+
 
 /**
  * Return the query (key in the plan_map) for the given request plan.
@@ -246,6 +294,81 @@ schedule_peer_transmission (void *cls,
                             const struct GNUNET_SCHEDULER_TaskContext *tc);
 
 
+/**
+ * Compute the weight of the given request plan in the priority heap.
+ * Normally this is just the priority; in token bucket mode, requests
+ * that have been waiting for a long time are preferred, so we use
+ * priority times age (in seconds).
+ *
+ * @param rp request plan
+ * @return weight for the priority heap
+ */
+static GNUNET_CONTAINER_HeapCostType
+get_priority_cost (struct GSF_RequestPlan *rp)
+{
+  struct GSF_PendingRequestData *prd;
+  uint64_t age;
+
+  if (GNUNET_YES != token_bucket_mode)
+    return rp->priority;
+  prd = GSF_pending_request_get_data_ (rp->pe_head->pr);
+  age = GNUNET_TIME_absolute_get_duration (prd->start_time).rel_value_us
+    / GNUNET_TIME_UNIT_SECONDS.rel_value_us;
+  return (rp->priority + 1) * (age + 1);
+}
+
+
+/**
+ * Get the rate (in queries per second) at which we may send queries
+ * to the given peer.  Derived from the peer's average reply delay
+ * (as maintained by GSF_peer_update_performance_()): we aim to keep
+ * #MAX_QUEUE_PER_PEER queries in flight.
+ *
+ * @param pp plan of the peer
+ * @return query rate for the peer
+ */
+static double
+get_query_rate (struct PeerPlan *pp)
+{
+  const struct GSF_PeerPerformanceData *ppd;
+  double rate;
+
+  ppd = GSF_get_peer_performance_data_ (pp->cp);
+  if (0 == ppd->avg_reply_delay.rel_value_us)
+    return MIN_QUERY_RATE;
+  rate = MAX_QUEUE_PER_PEER * 1000000.0 / ppd->avg_reply_delay.rel_value_us;
+  if (rate < MIN_QUERY_RATE)
+    return MIN_QUERY_RATE;
+  if (rate > MAX_QUERY_RATE)
+    return MAX_QUERY_RATE;
+  return rate;
+}
+
+
+/**
+ * Refill the token bucket of the given peer according to the time
+ * that passed since the last refill.
+ *
+ * @param pp plan of the peer
+ * @return current query rate of the peer
+ */
+static double
+refill_tokens (struct PeerPlan *pp)
+{
+  struct GNUNET_TIME_Absolute now;
+  double rate;
+
+  now = GNUNET_TIME_absolute_get ();
+  rate = get_query_rate (pp);
+  pp->tokens += rate * (now.abs_value_us - pp->bucket_update.abs_value_us)
+    / 1000000.0;
+  if (pp->tokens > MAX_QUEUE_PER_PEER)
+    pp->tokens = MAX_QUEUE_PER_PEER;
+  pp->bucket_update = now;
+  return rate;
+}
+
+
 /**
  * Insert the given request plan into the heap with the appropriate weight.
  *
@@ -261,7 +384,14 @@ plan (struct PeerPlan *pp, struct GSF_RequestPlan *rp)
    */
   static double avg_delay;
 
+  /**
+   * Running average of the reply delays of the peers we plan for
+   * (only counting peers that answered before).
+   */
+  static double avg_reply_delay;
+
   struct GSF_PendingRequestData *prd;
+  const struct GSF_PeerPerformanceData *ppd;
   struct GNUNET_TIME_Relative delay;
 
   GNUNET_assert (rp->pp == pp);
@@ -315,6 +445,20 @@ plan (struct PeerPlan *pp, struct GSF_RequestPlan *rp)
               1.0) * atan (delay.rel_value_us / avg_delay)) / M_PI_4;
   /* Note: usage of 'round' and 'atan' requires -lm */
 
+  /* prefer fast sources: the first transmission to a peer that
+     answers slower than average waits for the difference (bounded),
+     giving faster peers the chance to answer first */
+  ppd = GSF_get_peer_performance_data_ (pp->cp);
+  if (0 != ppd->avg_reply_delay.rel_value_us)
+  {
+    avg_reply_delay = ((avg_reply_delay * (N - 1.0)) +
+                       ppd->avg_reply_delay.rel_value_us) / N;
+    if ( (0 == rp->transmission_counter) &&
+         (ppd->avg_reply_delay.rel_value_us > avg_reply_delay) )
+      delay.rel_value_us +=
+        GNUNET_MIN ((uint64_t) (ppd->avg_reply_delay.rel_value_us - avg_reply_delay),
+                    MAX_SOURCE_STAGGER.rel_value_us);
+  }
   if (rp->transmission_counter != 0)
     delay.rel_value_us += TTL_DECREMENT * 1000;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -328,7 +472,8 @@ plan (struct PeerPlan *pp, struct GSF_RequestPlan *rp)
               GNUNET_h2s (&prd->query), rp->transmission_counter);
   GNUNET_assert (rp->hn == NULL);
   if (0 == GNUNET_TIME_absolute_get_remaining (rp->earliest_transmission).rel_value_us)
-    rp->hn = GNUNET_CONTAINER_heap_insert (pp->priority_heap, rp, rp->priority);
+    rp->hn = GNUNET_CONTAINER_heap_insert (pp->priority_heap, rp,
+                                           get_priority_cost (rp));
   else
     rp->hn =
         GNUNET_CONTAINER_heap_insert (pp->delay_heap, rp,
@@ -386,6 +531,8 @@ transmit_message_callback (void *cls, size_t buf_size, void *buf)
   struct PeerPlan *pp = cls;
   struct GSF_RequestPlan *rp;
   size_t msize;
+  size_t off;
+  unsigned int batched;
 
   pp->pth = NULL;
   if (NULL == buf)
@@ -418,21 +565,47 @@ transmit_message_callback (void *cls, size_t buf_size, void *buf)
     pp->task = GNUNET_SCHEDULER_add_now (&schedule_peer_transmission, pp);
     return 0;
   }
-  /* remove from root, add again elsewhere... */
-  GNUNET_assert (rp == GNUNET_CONTAINER_heap_remove_root (pp->priority_heap));
-  rp->hn = NULL;
-  rp->last_transmission = GNUNET_TIME_absolute_get ();
-  rp->transmission_counter++;
-  total_delay++;
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Executing plan %p executed %u times, planning retransmission\n",
-              rp, rp->transmission_counter);
-  plan (pp, rp);
+  off = 0;
+  batched = 0;
+  while (1)
+  {
+    /* remove from root, add again elsewhere... */
+    GNUNET_assert (rp == GNUNET_CONTAINER_heap_remove_root (pp->priority_heap));
+    rp->hn = NULL;
+    rp->last_transmission = GNUNET_TIME_absolute_get ();
+    rp->transmission_counter++;
+    total_delay++;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Executing plan %p executed %u times, planning retransmission\n",
+                rp, rp->transmission_counter);
+    plan (pp, rp);
+    off += msize;
+    batched++;
+    if (GNUNET_YES != token_bucket_mode)
+      break;
+    /* token bucket mode: append more queries while we have tokens
+       and space */
+    pp->tokens -= 1.0;
+    if ( (pp->tokens < 1.0) ||
+         (batched >= QUERY_BATCH_SIZE) ||
+         (NULL == (rp = GNUNET_CONTAINER_heap_peek (pp->priority_heap))) )
+      break;
+    msize = GSF_pending_request_get_message_ (get_latest (rp),
+                                              buf_size - off,
+                                              &((char *) buf)[off]);
+    if (msize > buf_size - off)
+      break;
+  }
   GNUNET_STATISTICS_update (GSF_stats,
                             gettext_noop
-                            ("# query messages sent to other peers"), 1,
+                            ("# query messages sent to other peers"), batched,
                             GNUNET_NO);
-  return msize;
+  if (batched > 1)
+    GNUNET_STATISTICS_update (GSF_stats,
+                              gettext_noop
+                              ("# query messages sent in batches"), batched,
+                              GNUNET_NO);
+  return off;
 }
 
 
@@ -450,6 +623,8 @@ schedule_peer_transmission (void *cls,
   struct GSF_RequestPlan *rp;
   size_t msize;
   struct GNUNET_TIME_Relative delay;
+  unsigned int batch;
+  double rate;
 
   pp->task = NULL;
   if (NULL != pp->pth)
@@ -463,7 +638,8 @@ schedule_peer_transmission (void *cls,
           (rp->earliest_transmission).rel_value_us))
   {
     GNUNET_assert (rp == GNUNET_CONTAINER_heap_remove_root (pp->delay_heap));
-    rp->hn = GNUNET_CONTAINER_heap_insert (pp->priority_heap, rp, rp->priority);
+    rp->hn = GNUNET_CONTAINER_heap_insert (pp->priority_heap, rp,
+                                           get_priority_cost (rp));
   }
   if (0 == GNUNET_CONTAINER_heap_get_size (pp->priority_heap))
   {
@@ -497,6 +673,29 @@ schedule_peer_transmission (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Executing query plan %p\n", rp);
   GNUNET_assert (NULL != rp);
   msize = GSF_pending_request_get_message_ (get_latest (rp), 0, NULL);
+  if (GNUNET_YES == token_bucket_mode)
+  {
+    rate = refill_tokens (pp);
+    if (pp->tokens < 1.0)
+    {
+      /* out of tokens, wait until we have one again */
+      delay.rel_value_us = (uint64_t) ((1.0 - pp->tokens) * 1000000.0 / rate) + 1;
+      GNUNET_STATISTICS_update (GSF_stats,
+                                gettext_noop ("# query transmissions delayed by token bucket"),
+                                1, GNUNET_NO);
+      pp->task =
+          GNUNET_SCHEDULER_add_delayed (delay, &schedule_peer_transmission, pp);
+      return;
+    }
+    /* ask for enough space to append further ready queries of
+       (roughly) the same size */
+    batch = GNUNET_MIN (GNUNET_CONTAINER_heap_get_size (pp->priority_heap),
+                        GNUNET_MIN ((unsigned int) pp->tokens,
+                                    QUERY_BATCH_SIZE));
+    if (msize * batch > QUERY_BATCH_MAX_BYTES)
+      batch = GNUNET_MAX (1, QUERY_BATCH_MAX_BYTES / msize);
+    msize *= batch;
+  }
   pp->pth =
       GSF_peer_transmit_ (pp->cp, GNUNET_YES, rp->priority,
                           GNUNET_TIME_UNIT_FOREVER_REL, msize,
@@ -595,6 +794,8 @@ GSF_plan_add_ (struct GSF_ConnectedPeer *cp,
     pp->delay_heap =
         GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
     pp->cp = cp;
+    pp->bucket_update = GNUNET_TIME_absolute_get ();
+    pp->tokens = MAX_QUEUE_PER_PEER;
     GNUNET_assert (GNUNET_OK ==
                    GNUNET_CONTAINER_multipeermap_put (plans,
                                                       id, pp,
@@ -780,6 +981,9 @@ void
 GSF_plan_init ()
 {
   plans = GNUNET_CONTAINER_multipeermap_create (256, GNUNET_YES);
+  token_bucket_mode =
+      GNUNET_CONFIGURATION_get_value_yesno (GSF_cfg, "fs",
+                                            "QUERY_TOKEN_BUCKETS");
 }
 
 
@@ -70,6 +70,20 @@
  */
 #define CADET_RETRY_MAX 3
 
+/**
+ * When the number of pending requests exceeds the limit, how many
+ * requests (as a fraction of the limit, 1/N) do we evict in one go?
+ * Evicting a batch leaves some headroom so that the next requests
+ * do not each have to pay for an eviction.
+ */
+#define EVICTION_BATCH_DIVISOR 64
+
+/**
+ * Largest size (in bytes) of a reply bloom filter we construct;
+ * must match the limit used by GNUNET_BLOCK_construct_bloomfilter().
+ */
+#define MAX_REPLY_BF_SIZE (1 << 15)
+
 
 /**
  * An active request.
@@ -241,6 +255,29 @@ static unsigned long long max_pending_requests = (32 * 1024);
 
 
 
+/**
+ * Compute the size of the reply bloom filter that
+ * GNUNET_BLOCK_construct_bloomfilter() would create for the
+ * given number of replies.
+ *
+ * @param entry_count number of replies the filter has to hold
+ * @return size of the bloom filter in bytes
+ */
+static size_t
+reply_bloomfilter_size (unsigned int entry_count)
+{
+  size_t size;
+  unsigned int ideal = (entry_count * GNUNET_CONSTANTS_BLOOMFILTER_K) / 4;
+
+  if (entry_count > MAX_REPLY_BF_SIZE)
+    return MAX_REPLY_BF_SIZE;
+  size = 8;
+  while ((size < MAX_REPLY_BF_SIZE) && (size < ideal))
+    size *= 2;
+  return size;
+}
+
+
 /**
  * Recalculate our bloom filter for filtering replies.  This function
  * will create a new bloom filter from scratch, so it should only be
@@ -302,6 +339,8 @@ GSF_pending_request_create_ (enum GSF_PendingRequestOptions options,
   struct GSF_PendingRequest *dpr;
   size_t extra;
   struct GNUNET_HashCode *eptr;
+  unsigned long long evict_limit;
+  unsigned int evicted;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Creating request handle for `%s' of type %d\n",
@@ -334,6 +373,7 @@ GSF_pending_request_create_ (enum GSF_PendingRequestOptions options,
   pr->origin_pid = origin_pid;
   pr->rh = rh;
   pr->rh_cls = rh_cls;
+  evicted = 0;
   GNUNET_assert ((sender_pid != 0) || (0 == (options & GSF_PRO_FORWARD_ONLY)));
   if (ttl >= 0)
     pr->public_data.ttl =
@@ -375,9 +415,17 @@ GSF_pending_request_create_ (enum GSF_PendingRequestOptions options,
     pr->hnode =
         GNUNET_CONTAINER_heap_insert (requests_by_expiration_heap, pr,
                                       pr->public_data.ttl.abs_value_us);
-    /* make sure we don't track too many requests */
+    /* make sure we don't track too many requests; if we are over
+       the limit, evict a whole batch so that the following requests
+       find some headroom */
+    if (GNUNET_CONTAINER_heap_get_size (requests_by_expiration_heap) >
+        max_pending_requests)
+      evict_limit = max_pending_requests
+        - max_pending_requests / EVICTION_BATCH_DIVISOR;
+    else
+      evict_limit = max_pending_requests;
     while (GNUNET_CONTAINER_heap_get_size (requests_by_expiration_heap) >
-           max_pending_requests)
+           evict_limit)
     {
       dpr = GNUNET_CONTAINER_heap_peek (requests_by_expiration_heap);
       GNUNET_assert (dpr != NULL);
@@ -388,7 +436,12 @@ GSF_pending_request_create_ (enum GSF_PendingRequestOptions options,
 		 UINT32_MAX, GNUNET_TIME_UNIT_FOREVER_ABS, GNUNET_TIME_UNIT_FOREVER_ABS,
                  GNUNET_BLOCK_TYPE_ANY, NULL, 0);
       GSF_pending_request_cancel_ (dpr, GNUNET_YES);
+      evicted++;
     }
+    if (evicted > 0)
+      GNUNET_STATISTICS_update (GSF_stats,
+                                gettext_noop ("# Pending requests evicted (table full)"),
+                                evicted, GNUNET_NO);
   }
   GNUNET_STATISTICS_update (GSF_stats,
                             gettext_noop ("# Pending requests active"), 1,
@@ -452,14 +505,30 @@ GSF_pending_request_update_ (struct GSF_PendingRequest *pr,
     return;                     /* integer overflow */
   if (0 != (pr->public_data.options & GSF_PRO_BLOOMFILTER_FULL_REFRESH))
   {
-    /* we're responsible for the BF, full refresh */
+    /* we're responsible for the BF */
     if (replies_seen_count + pr->replies_seen_count > pr->replies_seen_size)
       GNUNET_array_grow (pr->replies_seen, pr->replies_seen_size,
                          replies_seen_count + pr->replies_seen_count);
     memcpy (&pr->replies_seen[pr->replies_seen_count], replies_seen,
             sizeof (struct GNUNET_HashCode) * replies_seen_count);
     pr->replies_seen_count += replies_seen_count;
-    refresh_bloomfilter (pr);
+    if ( (NULL != pr->bf) &&
+         (GNUNET_CONTAINER_bloomfilter_get_size (pr->bf) ==
+          reply_bloomfilter_size (pr->replies_seen_count)) )
+    {
+      /* filter is still large enough; just add the new replies
+         in place instead of rebuilding it from all replies seen */
+      for (i = 0; i < replies_seen_count; i++)
+      {
+        GNUNET_BLOCK_mingle_hash (&replies_seen[i], pr->mingle, &mhash);
+        GNUNET_CONTAINER_bloomfilter_add (pr->bf, &mhash);
+      }
+    }
+    else
+    {
+      /* filter has to grow, full refresh */
+      refresh_bloomfilter (pr);
+    }
   }
   else
   {
@@ -475,7 +544,7 @@ GSF_pending_request_update_ (struct GSF_PendingRequest *pr,
     }
     else
     {
-      for (i = 0; i < pr->replies_seen_count; i++)
+      for (i = 0; i < replies_seen_count; i++)
       {
         GNUNET_BLOCK_mingle_hash (&replies_seen[i], pr->mingle, &mhash);
         GNUNET_CONTAINER_bloomfilter_add (pr->bf, &mhash);
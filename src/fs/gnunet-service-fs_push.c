@@ -52,6 +52,9 @@
 #define MIN_MIGRATION_CONTENT_LIFETIME GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 30)
 
 
+struct MigrationQueueEntry;
+
+
 /**
  * Block that is ready for migration to other peers.  Actual data is at the end of the block.
  */
@@ -68,6 +71,17 @@ struct MigrationReadyBlock
    */
   struct MigrationReadyBlock *prev;
 
+  /**
+   * Head of the queue entries of this block (one per peer
+   * the block may still be pushed to).
+   */
+  struct MigrationQueueEntry *qe_head;
+
+  /**
+   * Tail of the queue entries of this block.
+   */
+  struct MigrationQueueEntry *qe_tail;
+
   /**
    * Query for the block.
    */
@@ -132,6 +146,55 @@ struct MigrationReadyPeer
    * Message we are trying to push right now (or NULL)
    */
   struct PutMessage *msg;
+
+  /**
+   * Blocks that may be pushed to this peer, ordered by their score
+   * (see #score_content()).  Entries are `struct MigrationQueueEntry`s.
+   */
+  struct GNUNET_CONTAINER_Heap *queue;
+
+  /**
+   * Hash of the identity of the peer, used for scoring.
+   */
+  struct GNUNET_HashCode id_hash;
+
+  /**
+   * Interned identity of the peer.
+   */
+  GNUNET_PEER_Id pid;
+};
+
+
+/**
+ * Entry in the queue of a peer for a block that may be pushed
+ * to that peer.
+ */
+struct MigrationQueueEntry
+{
+  /**
+   * This is a doubly-linked list (of the entries of the block).
+   */
+  struct MigrationQueueEntry *next;
+
+  /**
+   * This is a doubly-linked list (of the entries of the block).
+   */
+  struct MigrationQueueEntry *prev;
+
+  /**
+   * The block.
+   */
+  struct MigrationReadyBlock *mb;
+
+  /**
+   * The peer whose queue this entry is in.
+   */
+  struct MigrationReadyPeer *mrp;
+
+  /**
+   * Node of this entry in the queue of @e mrp.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
 };
 
 
@@ -155,6 +218,11 @@ static struct MigrationReadyPeer *peer_head;
  */
 static struct MigrationReadyPeer *peer_tail;
 
+/**
+ * Map from peer identities to `struct MigrationReadyPeer`s.
+ */
+static struct GNUNET_CONTAINER_MultiPeerMap *peer_map;
+
 /**
  * Request to datastore for migration (or NULL).
  */
@@ -187,6 +255,75 @@ static int enabled;
 static int value_found;
 
 
+/**
+ * Check if sending this block to this peer would
+ * be a good idea.
+ *
+ * @param peer target peer
+ * @param block the block
+ * @return score (>= 0: feasible, negative: infeasible)
+ */
+static long
+score_content (struct MigrationReadyPeer *peer,
+               struct MigrationReadyBlock *block)
+{
+  unsigned int i;
+  uint32_t dist;
+
+  for (i = 0; i < MIGRATION_LIST_SIZE; i++)
+    if (block->target_list[i] == peer->pid)
+      return -1;
+  dist = GNUNET_CRYPTO_hash_distance_u32 (&block->query, &peer->id_hash);
+  /* closer distance, higher score: */
+  return UINT32_MAX - dist;
+}
+
+
+/**
+ * Add the given block to the queue of the given peer,
+ * unless the block was already pushed to the peer.
+ *
+ * @param mrp the peer
+ * @param mb the block
+ */
+static void
+queue_block (struct MigrationReadyPeer *mrp,
+             struct MigrationReadyBlock *mb)
+{
+  struct MigrationQueueEntry *qe;
+  long score;
+
+  score = score_content (mrp, mb);
+  if (score < 0)
+    return;
+  qe = GNUNET_new (struct MigrationQueueEntry);
+  qe->mb = mb;
+  qe->mrp = mrp;
+  qe->hn = GNUNET_CONTAINER_heap_insert (mrp->queue,
+                                         qe,
+                                         (GNUNET_CONTAINER_HeapCostType) score);
+  GNUNET_CONTAINER_DLL_insert (mb->qe_head,
+                               mb->qe_tail,
+                               qe);
+}
+
+
+/**
+ * Remove the given entry from the queue of its peer.
+ *
+ * @param qe entry to remove
+ */
+static void
+dequeue_block (struct MigrationQueueEntry *qe)
+{
+  GNUNET_CONTAINER_heap_remove_node (qe->hn);
+  GNUNET_CONTAINER_DLL_remove (qe->mb->qe_head,
+                               qe->mb->qe_tail,
+                               qe);
+  GNUNET_free (qe);
+}
+
+
 /**
  * Delete the given migration block.
  *
@@ -195,6 +332,8 @@ static int value_found;
 static void
 delete_migration_block (struct MigrationReadyBlock *mb)
 {
+  while (NULL != mb->qe_head)
+    dequeue_block (mb->qe_head);
   GNUNET_CONTAINER_DLL_remove (mig_head, mig_tail, mb);
   GNUNET_PEER_decrement_rcs (mb->target_list, MIGRATION_LIST_SIZE);
   mig_size--;
@@ -250,23 +389,19 @@ transmit_message (void *cls,
 
 
 /**
- * Send the given block to the given peer.
+ * Send the block of the given queue entry to its peer.
  *
- * @param peer target peer
- * @param block the block
- * @return #GNUNET_YES if the block was deleted (!)
+ * @param qe queue entry of the block, will be freed
  */
-static int
-transmit_content (struct MigrationReadyPeer *peer,
-                  struct MigrationReadyBlock *block)
+static void
+transmit_content (struct MigrationQueueEntry *qe)
 {
+  struct MigrationReadyPeer *peer = qe->mrp;
+  struct MigrationReadyBlock *block = qe->mb;
   size_t msize;
   struct PutMessage *msg;
   unsigned int i;
-  struct GSF_PeerPerformanceData *ppd;
-  int ret;
 
-  ppd = GSF_get_peer_performance_data_ (peer->peer);
   GNUNET_assert (NULL == peer->th);
   msize = sizeof (struct PutMessage) + block->size;
   msg = GNUNET_malloc (msize);
@@ -276,24 +411,18 @@ transmit_content (struct MigrationReadyPeer *peer,
   msg->expiration = GNUNET_TIME_absolute_hton (block->expiration);
   memcpy (&msg[1], &block[1], block->size);
   peer->msg = msg;
+  dequeue_block (qe);
   for (i = 0; i < MIGRATION_LIST_SIZE; i++)
   {
     if (block->target_list[i] == 0)
     {
-      block->target_list[i] = ppd->pid;
+      block->target_list[i] = peer->pid;
       GNUNET_PEER_change_rc (block->target_list[i], 1);
       break;
     }
   }
   if (MIGRATION_LIST_SIZE == i)
-  {
     delete_migration_block (block);
-    ret = GNUNET_YES;
-  }
-  else
-  {
-    ret = GNUNET_NO;
-  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Asking for transmission of %u bytes to %s for migration\n",
               msize,
@@ -303,7 +432,6 @@ transmit_content (struct MigrationReadyPeer *peer,
                                  GNUNET_TIME_UNIT_FOREVER_REL,
                                  msize,
                                  &transmit_message, peer);
-  return ret;
 }
 
 
@@ -326,37 +454,6 @@ count_targets (struct MigrationReadyBlock *block)
 }
 
 
-/**
- * Check if sending this block to this peer would
- * be a good idea.
- *
- * @param peer target peer
- * @param block the block
- * @return score (>= 0: feasible, negative: infeasible)
- */
-static long
-score_content (struct MigrationReadyPeer *peer,
-               struct MigrationReadyBlock *block)
-{
-  unsigned int i;
-  struct GSF_PeerPerformanceData *ppd;
-  struct GNUNET_PeerIdentity id;
-  struct GNUNET_HashCode hc;
-  uint32_t dist;
-
-  ppd = GSF_get_peer_performance_data_ (peer->peer);
-  for (i = 0; i < MIGRATION_LIST_SIZE; i++)
-    if (block->target_list[i] == ppd->pid)
-      return -1;
-  GNUNET_assert (0 != ppd->pid);
-  GNUNET_PEER_resolve (ppd->pid, &id);
-  GNUNET_CRYPTO_hash (&id, sizeof (struct GNUNET_PeerIdentity), &hc);
-  dist = GNUNET_CRYPTO_hash_distance_u32 (&block->query, &hc);
-  /* closer distance, higher score: */
-  return UINT32_MAX - dist;
-}
-
-
 /**
  * If the migration task is not currently running, consider
  * (re)scheduling it with the appropriate delay.
@@ -374,25 +471,14 @@ static void
 find_content (struct MigrationReadyPeer *mrp)
 {
   struct MigrationReadyBlock *pos;
+  struct MigrationReadyBlock *best;
+  struct MigrationQueueEntry *qe;
   long score;
   long best_score;
-  struct MigrationReadyBlock *best;
 
   GNUNET_assert (NULL == mrp->th);
-  best = NULL;
-  best_score = -1;
-  pos = mig_head;
-  while (NULL != pos)
-  {
-    score = score_content (mrp, pos);
-    if (score > best_score)
-    {
-      best_score = score;
-      best = pos;
-    }
-    pos = pos->next;
-  }
-  if (NULL == best)
+  qe = GNUNET_CONTAINER_heap_peek (mrp->queue);
+  if (NULL == qe)
   {
     if (mig_size < MAX_MIGRATION_QUEUE)
     {
@@ -405,6 +491,8 @@ find_content (struct MigrationReadyPeer *mrp)
     /* failed to find migration target AND
      * queue is full, purge most-forwarded
      * block from queue to make room for more */
+    best = NULL;
+    best_score = -1;
     pos = mig_head;
     while (NULL != pos)
     {
@@ -423,7 +511,7 @@ find_content (struct MigrationReadyPeer *mrp)
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Preparing to push best content to peer\n");
-  transmit_content (mrp, best);
+  transmit_content (qe);
 }
 
 
@@ -475,9 +563,10 @@ consider_gathering ()
 
 
 /**
- * Process content offered for migration.
+ * Add a block obtained from the datastore to the migration queue
+ * and to the queues of all connected peers.
  *
- * @param cls closure
+ * @param cls closure (unused)
  * @param key key for the content
  * @param size number of bytes in data
  * @param data content stored
@@ -489,50 +578,23 @@ consider_gathering ()
  *        maybe 0 if no unique identifier is available
  */
 static void
-process_migration_content (void *cls,
-                           const struct GNUNET_HashCode *key,
-                           size_t size,
-                           const void *data,
-                           enum GNUNET_BLOCK_Type type,
-                           uint32_t priority,
-                           uint32_t anonymity,
-                           struct GNUNET_TIME_Absolute expiration,
-                           uint64_t uid)
+add_migration_block (void *cls,
+                     const struct GNUNET_HashCode *key,
+                     size_t size,
+                     const void *data,
+                     enum GNUNET_BLOCK_Type type,
+                     uint32_t priority,
+                     uint32_t anonymity,
+                     struct GNUNET_TIME_Absolute expiration,
+                     uint64_t uid)
 {
   struct MigrationReadyBlock *mb;
   struct MigrationReadyPeer *pos;
 
-  mig_qe = NULL;
   if (NULL == key)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "No content found for migration...\n");
-    consider_gathering ();
-    return;
-  }
-  value_found = GNUNET_YES;
-  if (GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us <
-      MIN_MIGRATION_CONTENT_LIFETIME.rel_value_us)
-  {
-    /* content will expire soon, don't bother */
-    consider_gathering ();
     return;
-  }
-  if (type == GNUNET_BLOCK_TYPE_FS_ONDEMAND)
-  {
-    if (GNUNET_OK !=
-        GNUNET_FS_handle_on_demand_block (key,
-                                          size,
-                                          data,
-                                          type,
-                                          priority,
-                                          anonymity,
-                                          expiration,
-                                          uid,
-                                          &process_migration_content, NULL))
-      consider_gathering ();
+  if (mig_size >= MAX_MIGRATION_QUEUE)
     return;
-  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Retrieved block `%s' of type %u for migration (queue size: %u/%u)\n",
               GNUNET_h2s (key),
@@ -549,6 +611,8 @@ process_migration_content (void *cls,
                                      mig_tail,
                                      mb);
   mig_size++;
+  for (pos = peer_head; NULL != pos; pos = pos->next)
+    queue_block (pos, mb);
   for (pos = peer_head; NULL != pos; pos = pos->next)
   {
     if (NULL == pos->th)
@@ -556,11 +620,68 @@ process_migration_content (void *cls,
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                   "Preparing to push best content to peer %s\n",
                   GNUNET_i2s (GSF_connected_peer_get_identity2_(pos->peer)));
-      if (GNUNET_YES == transmit_content (pos, mb))
-        break;                  /* 'mb' was freed! */
+      find_content (pos);
     }
   }
-  consider_gathering ();
+}
+
+
+/**
+ * Process content offered for migration.
+ *
+ * @param cls closure
+ * @param key key for the content, NULL at the end of the batch
+ * @param size number of bytes in data
+ * @param data content stored
+ * @param type type of the content
+ * @param priority priority of the content
+ * @param anonymity anonymity-level for the content
+ * @param expiration expiration time for the content
+ * @param uid unique identifier for the datum;
+ *        maybe 0 if no unique identifier is available
+ */
+static void
+process_migration_content (void *cls,
+                           const struct GNUNET_HashCode *key,
+                           size_t size,
+                           const void *data,
+                           enum GNUNET_BLOCK_Type type,
+                           uint32_t priority,
+                           uint32_t anonymity,
+                           struct GNUNET_TIME_Absolute expiration,
+                           uint64_t uid)
+{
+  if (NULL == key)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "End of migration batch (queue size: %u)\n",
+                mig_size);
+    mig_qe = NULL;
+    consider_gathering ();
+    return;
+  }
+  value_found = GNUNET_YES;
+  if (GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us <
+      MIN_MIGRATION_CONTENT_LIFETIME.rel_value_us)
+  {
+    /* content will expire soon, don't bother */
+    return;
+  }
+  if (type == GNUNET_BLOCK_TYPE_FS_ONDEMAND)
+  {
+    (void) GNUNET_FS_handle_on_demand_block (key,
+                                             size,
+                                             data,
+                                             type,
+                                             priority,
+                                             anonymity,
+                                             expiration,
+                                             uid,
+                                             &add_migration_block, NULL);
+    return;
+  }
+  add_migration_block (NULL, key, size, data, type,
+                       priority, anonymity, expiration, uid);
 }
 
 
@@ -581,13 +702,16 @@ gather_migration_blocks (void *cls,
   if (NULL == GSF_dsh)
     return;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Asking datastore for content for replication (queue size: %u)\n",
+              "Asking datastore for %u blocks for replication (queue size: %u)\n",
+              MAX_MIGRATION_QUEUE - mig_size,
               mig_size);
   value_found = GNUNET_NO;
   mig_qe =
-    GNUNET_DATASTORE_get_for_replication (GSF_dsh, 0, UINT_MAX,
-                                          GNUNET_TIME_UNIT_FOREVER_REL,
-                                          &process_migration_content, NULL);
+    GNUNET_DATASTORE_get_for_replication_multi (GSF_dsh,
+                                                MAX_MIGRATION_QUEUE - mig_size,
+                                                0, UINT_MAX,
+                                                GNUNET_TIME_UNIT_FOREVER_REL,
+                                                &process_migration_content, NULL);
   if (NULL == mig_qe)
     consider_gathering ();
 }
@@ -603,13 +727,13 @@ void
 GSF_push_start_ (struct GSF_ConnectedPeer *peer)
 {
   struct MigrationReadyPeer *mrp;
+  struct MigrationReadyBlock *pos;
+  const struct GNUNET_PeerIdentity *id;
 
   if (GNUNET_YES != enabled)
     return;
-  for (mrp = peer_head; NULL != mrp; mrp = mrp->next)
-    if (mrp->peer == peer)
-      break;
-  if (NULL != mrp)
+  id = GSF_connected_peer_get_identity2_ (peer);
+  if (NULL != GNUNET_CONTAINER_multipeermap_get (peer_map, id))
   {
     /* same peer added twice, must not happen */
     GNUNET_break (0);
@@ -618,33 +742,40 @@ GSF_push_start_ (struct GSF_ConnectedPeer *peer)
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Adding peer %s to list for pushing\n",
-              GNUNET_i2s (GSF_connected_peer_get_identity2_(peer)));
+              GNUNET_i2s (id));
 
   mrp = GNUNET_new (struct MigrationReadyPeer);
   mrp->peer = peer;
+  mrp->pid = GSF_get_peer_performance_data_ (peer)->pid;
+  GNUNET_assert (0 != mrp->pid);
+  GNUNET_CRYPTO_hash (id, sizeof (struct GNUNET_PeerIdentity), &mrp->id_hash);
+  mrp->queue = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MAX);
+  for (pos = mig_head; NULL != pos; pos = pos->next)
+    queue_block (mrp, pos);
   find_content (mrp);
   GNUNET_CONTAINER_DLL_insert (peer_head,
                                peer_tail,
                                mrp);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multipeermap_put (peer_map, id, mrp,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
 }
 
 
 /**
- * A peer disconnected from us.  Stop pushing content
- * to this peer.
+ * Stop pushing content to the given peer and free its state.
  *
- * @param peer handle for the peer that disconnected
+ * @param pos the peer to release
  */
-void
-GSF_push_stop_ (struct GSF_ConnectedPeer *peer)
+static void
+release_peer (struct MigrationReadyPeer *pos)
 {
-  struct MigrationReadyPeer *pos;
+  struct MigrationQueueEntry *qe;
 
-  for (pos = peer_head; NULL != pos; pos = pos->next)
-    if (pos->peer == peer)
-      break;
-  if (NULL == pos)
-    return;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multipeermap_remove (peer_map,
+                                                       GSF_connected_peer_get_identity2_ (pos->peer),
+                                                       pos));
   GNUNET_CONTAINER_DLL_remove (peer_head,
                                peer_tail,
                                pos);
@@ -658,10 +789,34 @@ GSF_push_stop_ (struct GSF_ConnectedPeer *peer)
     GNUNET_free (pos->msg);
     pos->msg = NULL;
   }
+  while (NULL != (qe = GNUNET_CONTAINER_heap_peek (pos->queue)))
+    dequeue_block (qe);
+  GNUNET_CONTAINER_heap_destroy (pos->queue);
   GNUNET_free (pos);
 }
 
 
+/**
+ * A peer disconnected from us.  Stop pushing content
+ * to this peer.
+ *
+ * @param peer handle for the peer that disconnected
+ */
+void
+GSF_push_stop_ (struct GSF_ConnectedPeer *peer)
+{
+  struct MigrationReadyPeer *pos;
+
+  if (NULL == peer_map)
+    return;
+  pos = GNUNET_CONTAINER_multipeermap_get (peer_map,
+                                           GSF_connected_peer_get_identity2_ (peer));
+  if (NULL == pos)
+    return;
+  release_peer (pos);
+}
+
+
 /**
  * Setup the module.
  */
@@ -672,7 +827,7 @@ GSF_push_init_ ()
       GNUNET_CONFIGURATION_get_value_yesno (GSF_cfg, "FS", "CONTENT_PUSHING");
   if (GNUNET_YES != enabled)
     return;
-
+  peer_map = GNUNET_CONTAINER_multipeermap_create (256, GNUNET_YES);
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_time (GSF_cfg, "fs", "MIN_MIGRATION_DELAY",
                                            &min_migration_delay))
@@ -705,6 +860,13 @@ GSF_push_done_ ()
   while (NULL != mig_head)
     delete_migration_block (mig_head);
   GNUNET_assert (0 == mig_size);
+  while (NULL != peer_head)
+    release_peer (peer_head);
+  if (NULL != peer_map)
+  {
+    GNUNET_CONTAINER_multipeermap_destroy (peer_map);
+    peer_map = NULL;
+  }
 }
 
 /* end of gnunet-service-fs_push.c */
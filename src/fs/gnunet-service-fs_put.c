@@ -38,6 +38,25 @@
  */
 #define DEFAULT_PUT_REPLICATION 5
 
+/**
+ * How many blocks do we take from the datastore (and PUT into
+ * the DHT) at most per batch?
+ */
+#define DHT_PUT_BATCH_SIZE 32
+
+/**
+ * How many bytes of block data do we put into a single DHT
+ * batch at most?  Must leave room for the per-record overhead
+ * within the maximum message size.
+ */
+#define DHT_PUT_BATCH_BYTES (32 * 1024)
+
+/**
+ * For how many blocks do we remember at most that we recently
+ * PUT them into the DHT?
+ */
+#define MAX_RECENT_PUTS (64 * 1024)
+
 
 /**
  * Context for each zero-anonymity iterator.
@@ -75,6 +94,40 @@ struct PutOperator
    * Current offset when iterating the database.
    */
   uint64_t current_offset;
+
+  /**
+   * Map from the hash of recently PUT blocks to the
+   * `struct GNUNET_TIME_Absolute` at which we PUT them.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *recent;
+
+  /**
+   * Records of the batch we are currently assembling.
+   */
+  struct GNUNET_DHT_PutRecord records[DHT_PUT_BATCH_SIZE];
+
+  /**
+   * Number of entries used in @e records.
+   */
+  unsigned int num_records;
+
+  /**
+   * Number of bytes of block data in @e records.
+   */
+  size_t batch_bytes;
+
+  /**
+   * Number of values from the datastore we consumed for the
+   * current batch (including those we did not PUT).
+   */
+  unsigned int batch_consumed;
+
+  /**
+   * Set to #GNUNET_YES once @e records has no room for more data;
+   * further values of the current datastore batch are skipped and
+   * fetched again for the next batch.
+   */
+  int batch_full;
 };
 
 
@@ -87,6 +140,12 @@ static struct PutOperator operators[] = {
   {NULL, GNUNET_BLOCK_TYPE_ANY, 0, 0, 0}
 };
 
+/**
+ * How many bytes per second are we allowed to PUT into the
+ * DHT (0 for no limit)?
+ */
+static unsigned long long put_bandwidth;
+
 
 /**
  * Task that is run periodically to obtain blocks for DHT PUTs.
@@ -101,6 +160,9 @@ gather_dht_put_blocks (void *cls,
 
 /**
  * Calculate when to run the next PUT operation and schedule it.
+ * Batches are spaced such that a full pass over the datastore
+ * takes about #GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY, but never
+ * faster than the configured bandwidth allows.
  *
  * @param po put operator to schedule
  */
@@ -108,11 +170,15 @@ static void
 schedule_next_put (struct PutOperator *po)
 {
   struct GNUNET_TIME_Relative delay;
+  struct GNUNET_TIME_Relative budget;
 
   if (po->zero_anonymity_count_estimate > 0)
   {
     delay =
-        GNUNET_TIME_relative_divide (GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY,
+        GNUNET_TIME_relative_multiply (GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY,
+                                       GNUNET_MAX (1, po->batch_consumed));
+    delay =
+        GNUNET_TIME_relative_divide (delay,
                                      po->zero_anonymity_count_estimate);
     delay = GNUNET_TIME_relative_min (delay, MAX_DHT_PUT_FREQ);
   }
@@ -122,6 +188,12 @@ schedule_next_put (struct PutOperator *po)
      * (hopefully) appear */
     delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5);
   }
+  if (0 != put_bandwidth)
+  {
+    budget = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                            po->batch_bytes * 1000LLU / put_bandwidth);
+    delay = GNUNET_TIME_relative_max (delay, budget);
+  }
   po->dht_task =
       GNUNET_SCHEDULER_add_delayed (delay, &gather_dht_put_blocks, po);
 }
@@ -163,6 +235,128 @@ delay_dht_put_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 }
 
 
+/**
+ * Forget about a block we PUT a long time ago.
+ *
+ * @param cls the `struct PutOperator`
+ * @param key hash of the block
+ * @param value the `struct GNUNET_TIME_Absolute` of the PUT
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+expire_recent_put (void *cls,
+                   const struct GNUNET_HashCode *key,
+                   void *value)
+{
+  struct PutOperator *po = cls;
+  struct GNUNET_TIME_Absolute *put_time = value;
+
+  if (GNUNET_TIME_absolute_get_duration (*put_time).rel_value_us <
+      GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY.rel_value_us)
+    return GNUNET_YES;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (po->recent,
+                                                       key,
+                                                       put_time));
+  GNUNET_free (put_time);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Free an entry of the map of recent PUTs.
+ *
+ * @param cls unused
+ * @param key hash of the block
+ * @param value the `struct GNUNET_TIME_Absolute` of the PUT
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+free_recent_put (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  GNUNET_free (value);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Check if we PUT the given block into the DHT recently (within
+ * the republish frequency), and if not, remember that we are
+ * doing so now.
+ *
+ * @param po put operator
+ * @param size number of bytes in @a data
+ * @param data the block
+ * @return #GNUNET_YES if the block was PUT recently
+ */
+static int
+check_recent_put (struct PutOperator *po,
+                  size_t size,
+                  const void *data)
+{
+  struct GNUNET_HashCode hc;
+  struct GNUNET_TIME_Absolute *put_time;
+
+  GNUNET_CRYPTO_hash (data, size, &hc);
+  put_time = GNUNET_CONTAINER_multihashmap_get (po->recent, &hc);
+  if (NULL != put_time)
+  {
+    if (GNUNET_TIME_absolute_get_duration (*put_time).rel_value_us <
+        GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY.rel_value_us)
+      return GNUNET_YES;
+    *put_time = GNUNET_TIME_absolute_get ();
+    return GNUNET_NO;
+  }
+  if (GNUNET_CONTAINER_multihashmap_size (po->recent) >= MAX_RECENT_PUTS)
+    return GNUNET_NO;
+  put_time = GNUNET_new (struct GNUNET_TIME_Absolute);
+  *put_time = GNUNET_TIME_absolute_get ();
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (po->recent,
+                                                    &hc,
+                                                    put_time,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return GNUNET_NO;
+}
+
+
+/**
+ * PUT the batch we assembled into the DHT.
+ *
+ * @param po put operator with the batch
+ */
+static void
+put_batch (struct PutOperator *po)
+{
+  unsigned int i;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Putting %u blocks (%u bytes) of type %u into the DHT\n",
+              po->num_records,
+              (unsigned int) po->batch_bytes,
+              po->dht_put_type);
+  po->dht_put = GNUNET_DHT_put_batch (GSF_dht,
+                                      po->num_records, po->records,
+                                      DEFAULT_PUT_REPLICATION,
+                                      GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
+                                      GNUNET_TIME_UNIT_FOREVER_REL,
+                                      &delay_dht_put_blocks, po);
+  GNUNET_STATISTICS_update (GSF_stats,
+                            gettext_noop ("# blocks PUT into the DHT"),
+                            po->num_records, GNUNET_NO);
+  for (i = 0; i < po->num_records; i++)
+    GNUNET_free ((void *) po->records[i].data);
+  po->num_records = 0;
+  if (NULL == po->dht_put)
+  {
+    GNUNET_break (0);
+    schedule_next_put (po);
+  }
+}
+
+
 /**
  * Store content in DHT.
  *
@@ -187,24 +381,61 @@ process_dht_put_content (void *cls,
                          struct GNUNET_TIME_Absolute expiration, uint64_t uid)
 {
   struct PutOperator *po = cls;
+  struct GNUNET_DHT_PutRecord *rec;
+  void *copy;
 
-  po->dht_qe = NULL;
   if (key == NULL)
   {
-    po->zero_anonymity_count_estimate = po->current_offset - 1;
-    po->current_offset = 0;
-    po->dht_task = GNUNET_SCHEDULER_add_now (&delay_dht_put_task, po);
+    po->dht_qe = NULL;
+    if ( (GNUNET_NO == po->batch_full) &&
+         (po->batch_consumed < DHT_PUT_BATCH_SIZE) )
+    {
+      /* end of the database, start over */
+      po->zero_anonymity_count_estimate = po->current_offset;
+      po->current_offset = 0;
+      GNUNET_CONTAINER_multihashmap_iterate (po->recent,
+                                             &expire_recent_put,
+                                             po);
+    }
+    if (0 == po->num_records)
+    {
+      po->dht_task = GNUNET_SCHEDULER_add_now (&delay_dht_put_task, po);
+      return;
+    }
+    put_batch (po);
+    return;
+  }
+  if (GNUNET_YES == po->batch_full)
+    return; /* fetched again for the next batch */
+  if ( (po->num_records > 0) &&
+       (po->batch_bytes + size > DHT_PUT_BATCH_BYTES) )
+  {
+    po->batch_full = GNUNET_YES;
     return;
   }
+  po->current_offset++;
+  po->batch_consumed++;
   po->zero_anonymity_count_estimate =
       GNUNET_MAX (po->current_offset, po->zero_anonymity_count_estimate);
+  if (GNUNET_YES == check_recent_put (po, size, data))
+  {
+    GNUNET_STATISTICS_update (GSF_stats,
+                              gettext_noop ("# DHT PUTs skipped (published recently)"),
+                              1, GNUNET_NO);
+    return;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Retrieved block `%s' of type %u for DHT PUT\n", GNUNET_h2s (key),
               type);
-  po->dht_put = GNUNET_DHT_put (GSF_dht, key, DEFAULT_PUT_REPLICATION,
-				GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE, type, size, data,
-				expiration, GNUNET_TIME_UNIT_FOREVER_REL,
-				&delay_dht_put_blocks, po);
+  copy = GNUNET_malloc (size);
+  memcpy (copy, data, size);
+  rec = &po->records[po->num_records++];
+  rec->key = *key;
+  rec->type = type;
+  rec->size = size;
+  rec->data = copy;
+  rec->expiration = expiration;
+  po->batch_bytes += size;
 }
 
 
@@ -222,12 +453,17 @@ gather_dht_put_blocks (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   po->dht_task = NULL;
   if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
     return;
+  po->num_records = 0;
+  po->batch_bytes = 0;
+  po->batch_consumed = 0;
+  po->batch_full = GNUNET_NO;
   po->dht_qe =
-      GNUNET_DATASTORE_get_zero_anonymity (GSF_dsh, po->current_offset++, 0,
-                                           UINT_MAX,
-                                           GNUNET_TIME_UNIT_FOREVER_REL,
-                                           po->dht_put_type,
-                                           &process_dht_put_content, po);
+      GNUNET_DATASTORE_get_zero_anonymity_multi (GSF_dsh, po->current_offset,
+                                                 DHT_PUT_BATCH_SIZE,
+                                                 0, UINT_MAX,
+                                                 GNUNET_TIME_UNIT_FOREVER_REL,
+                                                 po->dht_put_type,
+                                                 &process_dht_put_content, po);
   if (NULL == po->dht_qe)
     po->dht_task = GNUNET_SCHEDULER_add_now (&delay_dht_put_task, po);
 }
@@ -241,9 +477,15 @@ GSF_put_init_ ()
 {
   unsigned int i;
 
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (GSF_cfg, "fs", "DHT_PUT_BANDWIDTH",
+                                           &put_bandwidth))
+    put_bandwidth = 0;
   i = 0;
   while (operators[i].dht_put_type != GNUNET_BLOCK_TYPE_ANY)
   {
+    operators[i].recent = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                                GNUNET_NO);
     operators[i].dht_task =
         GNUNET_SCHEDULER_add_now (&gather_dht_put_blocks, &operators[i]);
     i++;
@@ -278,6 +520,16 @@ GSF_put_done_ ()
       GNUNET_DATASTORE_cancel (po->dht_qe);
       po->dht_qe = NULL;
     }
+    while (po->num_records > 0)
+      GNUNET_free ((void *) po->records[--po->num_records].data);
+    if (NULL != po->recent)
+    {
+      GNUNET_CONTAINER_multihashmap_iterate (po->recent,
+                                             &free_recent_put,
+                                             NULL);
+      GNUNET_CONTAINER_multihashmap_destroy (po->recent);
+      po->recent = NULL;
+    }
     i++;
   }
 }
@@ -32,10 +32,9 @@
 
 
 /**
- * Number of bits we set per entry in the bloomfilter.
- * Do not change!
+ * Number of UBlock verification results we remember.
  */
-#define BLOOMFILTER_K 16
+#define VERIFICATION_CACHE_SIZE 256
 
 /**
  * Function called to validate a reply or a request.  For
@@ -68,10 +67,11 @@ block_plugin_fs_evaluate (void *cls,
                           const void *reply_block,
                           size_t reply_block_size)
 {
+  struct GNUNET_BLOCK_VerificationCache *cache = cls;
   const struct UBlock *ub;
   struct GNUNET_HashCode hc;
   struct GNUNET_HashCode chash;
-  struct GNUNET_HashCode mhash;
+  int ret;
 
   switch (type)
   {
@@ -115,36 +115,32 @@ block_plugin_fs_evaluate (void *cls,
       GNUNET_break_op (0);
       return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
     }
-    if ( (0 == (eo & GNUNET_BLOCK_EO_LOCAL_SKIP_CRYPTO)) &&
-         (GNUNET_OK !=
-          GNUNET_CRYPTO_ecdsa_verify (GNUNET_SIGNATURE_PURPOSE_FS_UBLOCK,
-                                      &ub->purpose,
-                                      &ub->signature,
-                                      &ub->verification_key)) )
+    GNUNET_CRYPTO_hash (reply_block,
+                        reply_block_size,
+                        &chash);
+    if (0 == (eo & GNUNET_BLOCK_EO_LOCAL_SKIP_CRYPTO))
     {
-      GNUNET_break_op (0);
-      return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
-    }
-    if (NULL != bf)
-    {
-      GNUNET_CRYPTO_hash (reply_block,
-                          reply_block_size,
-                          &chash);
-      GNUNET_BLOCK_mingle_hash (&chash,
-                                bf_mutator,
-                                &mhash);
-      if (NULL != *bf)
+      /* the same UBlock usually reaches us on several routes, only
+         check its signature the first time */
+      ret = GNUNET_BLOCK_verification_cache_get (cache, &chash);
+      if (GNUNET_NO == ret)
       {
-        if (GNUNET_YES ==
-            GNUNET_CONTAINER_bloomfilter_test (*bf, &mhash))
-          return GNUNET_BLOCK_EVALUATION_OK_DUPLICATE;
+        ret = GNUNET_CRYPTO_ecdsa_verify (GNUNET_SIGNATURE_PURPOSE_FS_UBLOCK,
+                                          &ub->purpose,
+                                          &ub->signature,
+                                          &ub->verification_key);
+        GNUNET_BLOCK_verification_cache_put (cache, &chash,
+                                             (GNUNET_OK == ret) ? GNUNET_OK : GNUNET_SYSERR);
       }
-      else
+      if (GNUNET_OK != ret)
       {
-        *bf = GNUNET_CONTAINER_bloomfilter_init (NULL, 8, BLOOMFILTER_K);
+        GNUNET_break_op (0);
+        return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
       }
-      GNUNET_CONTAINER_bloomfilter_add (*bf, &mhash);
     }
+    if (GNUNET_YES ==
+        GNUNET_BLOCK_check_reply_filter (bf, bf_mutator, &chash))
+      return GNUNET_BLOCK_EVALUATION_OK_DUPLICATE;
     return GNUNET_BLOCK_EVALUATION_OK_MORE;
   default:
     return GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED;
@@ -212,6 +208,7 @@ libgnunet_plugin_block_fs_init (void *cls)
   struct GNUNET_BLOCK_PluginFunctions *api;
 
   api = GNUNET_new (struct GNUNET_BLOCK_PluginFunctions);
+  api->cls = GNUNET_BLOCK_verification_cache_create (VERIFICATION_CACHE_SIZE);
   api->evaluate = &block_plugin_fs_evaluate;
   api->get_key = &block_plugin_fs_get_key;
   api->types = types;
@@ -225,8 +222,9 @@ libgnunet_plugin_block_fs_init (void *cls)
 void *
 libgnunet_plugin_block_fs_done (void *cls)
 {
-  struct GNUNET_TRANSPORT_PluginFunctions *api = cls;
+  struct GNUNET_BLOCK_PluginFunctions *api = cls;
 
+  GNUNET_BLOCK_verification_cache_destroy (api->cls);
   GNUNET_free (api);
   return NULL;
 }
@@ -49,6 +49,8 @@ static unsigned int anonymity_level;
 
 static int indexed;
 
+static enum GNUNET_FS_DownloadOptions download_options;
+
 static struct GNUNET_TIME_Absolute start;
 
 static struct GNUNET_FS_Handle *fs;
@@ -163,7 +165,7 @@ progress_cb (void *cls, const struct GNUNET_FS_ProgressInfo *event)
                                   event->value.publish.specifics.
                                   completed.chk_uri, NULL, fn, NULL, 0,
                                   FILESIZE, anonymity_level,
-				  GNUNET_FS_DOWNLOAD_OPTION_NONE,
+				  download_options,
                                   "download", NULL);
     GNUNET_assert (download != NULL);
     break;
@@ -336,6 +338,11 @@ main (int argc, char *argv[])
     binary_name = "test-fs-download-cadet";
     config_name = "test_fs_download_cadet.conf";
   }
+  if (NULL != strstr (argv[0], "swarm"))
+  {
+    binary_name = "test-fs-download-swarm";
+    download_options = GNUNET_FS_DOWNLOAD_OPTION_SWARM;
+  }
   if (0 != GNUNET_TESTING_peer_run (binary_name,
 				    config_name,
 				    &run, (void *) binary_name))
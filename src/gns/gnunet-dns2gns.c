@@ -45,11 +45,57 @@
  */
 #define FCFS_SUFFIX "fcfs.zkey.eu"
 
+/**
+ * How many datagrams do we read with one system call at most?
+ */
+#define RECV_BATCH_SIZE 32
+
+/**
+ * Size of the buffer for each received datagram.  DNS queries are
+ * small, larger datagrams are truncated (and then fail to parse).
+ */
+#define MAX_QUERY_SIZE 4096
+
+/**
+ * How many GNS results do we cache at most?
+ */
+#define MAX_CACHE_SIZE 16384
+
+/**
+ * How long do we cache GNS results at most (even if the records
+ * are valid for longer)?
+ */
+#define MAX_CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+
+/**
+ * How long do we cache empty GNS results?
+ */
+#define NEGATIVE_CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+
+struct PendingLookup;
+
+
 /**
  * Data kept per request.
  */
 struct Request
 {
+  /**
+   * Kept in a DLL per pending lookup.
+   */
+  struct Request *next;
+
+  /**
+   * Kept in a DLL per pending lookup.
+   */
+  struct Request *prev;
+
+  /**
+   * GNS lookup we are waiting for, NULL for none.
+   */
+  struct PendingLookup *pl;
+
   /**
    * Socket to use for sending the reply.
    */
@@ -66,11 +112,6 @@ struct Request
    */
   struct GNUNET_DNSPARSER_Packet *packet;
 
-  /**
-   * Our GNS request handle.
-   */
-  struct GNUNET_GNS_LookupRequest *lookup;
-
   /**
    * Our DNS request handle
    */
@@ -90,6 +131,70 @@ struct Request
 };
 
 
+/**
+ * A GNS lookup that one or more requests are waiting for.  Requests
+ * for the same name and type that arrive while the lookup is running
+ * are coalesced into it.
+ */
+struct PendingLookup
+{
+  /**
+   * Key of this lookup in #pending_map (and of the result in #cache_map).
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Our GNS request handle.
+   */
+  struct GNUNET_GNS_LookupRequest *lookup;
+
+  /**
+   * Head of DLL of requests waiting for this lookup.
+   */
+  struct Request *req_head;
+
+  /**
+   * Tail of DLL of requests waiting for this lookup.
+   */
+  struct Request *req_tail;
+
+};
+
+
+/**
+ * A cached GNS result.
+ */
+struct CacheEntry
+{
+  /**
+   * Key of this entry in #cache_map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Entry in #cache_heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * When does this entry expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * The records, with absolute expiration times; allocated
+   * (with their data) after this struct.
+   */
+  struct GNUNET_GNSRECORD_Data *rd;
+
+  /**
+   * Number of entries in @e rd.
+   */
+  unsigned int rd_count;
+
+};
+
+
 /**
  * Handle to GNS resolver.
  */
@@ -165,6 +270,254 @@ static struct GNUNET_IDENTITY_Handle *identity;
  */
 static struct GNUNET_IDENTITY_Operation *id_op;
 
+/**
+ * GNS lookups in progress, maps keys from #get_lookup_key() to
+ * `struct PendingLookup`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *pending_map;
+
+/**
+ * Cached GNS results, maps keys from #get_lookup_key() to
+ * `struct CacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *cache_map;
+
+/**
+ * Cached GNS results, by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *cache_heap;
+
+/**
+ * Set SO_REUSEPORT on our sockets, so that several processes
+ * can serve the same port?
+ */
+static int reuse_port;
+
+
+/**
+ * Compute the key under which GNS lookups for @a name and @a type
+ * are coalesced and cached.  Names are compared case-insensitively.
+ *
+ * @param name GNS name to look up
+ * @param type record type to look up
+ * @param key[out] set to the key
+ */
+static void
+get_lookup_key (const char *name,
+                int type,
+                struct GNUNET_HashCode *key)
+{
+  size_t name_len = strlen (name);
+  char buf[name_len + sizeof (uint32_t)];
+  uint32_t ntype = htonl ((uint32_t) type);
+  size_t i;
+
+  for (i=0;i<name_len;i++)
+    buf[i] = tolower ((unsigned char) name[i]);
+  memcpy (&buf[name_len], &ntype, sizeof (ntype));
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), key);
+}
+
+
+/**
+ * Remove a cache entry from the cache and free it.
+ *
+ * @param ce entry to free
+ */
+static void
+expire_cache_entry (struct CacheEntry *ce)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (cache_map,
+                                                       &ce->key,
+                                                       ce));
+  GNUNET_CONTAINER_heap_remove_node (ce->hn);
+  GNUNET_free (ce);
+}
+
+
+/**
+ * Free a cache entry during shutdown.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct CacheEntry` to free
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_cache_entry (void *cls,
+                  const struct GNUNET_HashCode *key,
+                  void *value)
+{
+  expire_cache_entry (value);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create a cache entry for a GNS result.  Relative expiration times
+ * are converted to absolute ones, so the records can be used to
+ * answer later requests.
+ *
+ * @param key key of the lookup
+ * @param rd_count number of records in @a rd
+ * @param rd the records
+ * @return the new entry, not yet in the cache
+ */
+static struct CacheEntry *
+create_cache_entry (const struct GNUNET_HashCode *key,
+                    unsigned int rd_count,
+                    const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct CacheEntry *ce;
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_TIME_Absolute at;
+  size_t size;
+  char *data;
+  unsigned int i;
+
+  size = sizeof (struct CacheEntry)
+    + rd_count * sizeof (struct GNUNET_GNSRECORD_Data);
+  for (i=0;i<rd_count;i++)
+    size += rd[i].data_size;
+  ce = GNUNET_malloc (size);
+  ce->key = *key;
+  ce->rd_count = rd_count;
+  ce->rd = (struct GNUNET_GNSRECORD_Data *) &ce[1];
+  data = (char *) &ce->rd[rd_count];
+  now = GNUNET_TIME_absolute_get ();
+  if (0 == rd_count)
+    ce->expiration = GNUNET_TIME_relative_to_absolute (NEGATIVE_CACHE_TTL);
+  else
+    ce->expiration = GNUNET_TIME_relative_to_absolute (MAX_CACHE_TTL);
+  for (i=0;i<rd_count;i++)
+  {
+    ce->rd[i] = rd[i];
+    ce->rd[i].data = data;
+    memcpy (data, rd[i].data, rd[i].data_size);
+    data += rd[i].data_size;
+    if (0 != (rd[i].flags & GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION))
+    {
+      struct GNUNET_TIME_Relative rt;
+
+      rt.rel_value_us = rd[i].expiration_time;
+      at = GNUNET_TIME_absolute_add (now, rt);
+      ce->rd[i].expiration_time = at.abs_value_us;
+      ce->rd[i].flags &= ~GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION;
+    }
+    at.abs_value_us = ce->rd[i].expiration_time;
+    ce->expiration = GNUNET_TIME_absolute_min (ce->expiration, at);
+  }
+  return ce;
+}
+
+
+/**
+ * Add a cache entry to the cache, or free it if it is already
+ * expired.  Evicts the entry that expires first if the cache is full.
+ *
+ * @param ce entry to add
+ */
+static void
+cache_result (struct CacheEntry *ce)
+{
+  struct CacheEntry *old;
+
+  if (0 == GNUNET_TIME_absolute_get_remaining (ce->expiration).rel_value_us)
+  {
+    GNUNET_free (ce);
+    return;
+  }
+  old = GNUNET_CONTAINER_multihashmap_get (cache_map,
+                                           &ce->key);
+  if (NULL != old)
+    expire_cache_entry (old);
+  while (GNUNET_CONTAINER_heap_get_size (cache_heap) >= MAX_CACHE_SIZE)
+    expire_cache_entry (GNUNET_CONTAINER_heap_peek (cache_heap));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (cache_map,
+                                                    &ce->key,
+                                                    ce,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  ce->hn = GNUNET_CONTAINER_heap_insert (cache_heap,
+                                         ce,
+                                         ce->expiration.abs_value_us);
+}
+
+
+/**
+ * Find a (still valid) cached result.
+ *
+ * @param key key of the lookup
+ * @return NULL if we have no valid result cached
+ */
+static struct CacheEntry *
+get_cached_result (const struct GNUNET_HashCode *key)
+{
+  struct CacheEntry *ce;
+
+  ce = GNUNET_CONTAINER_multihashmap_get (cache_map,
+                                          key);
+  if (NULL == ce)
+    return NULL;
+  if (0 == GNUNET_TIME_absolute_get_remaining (ce->expiration).rel_value_us)
+  {
+    expire_cache_entry (ce);
+    return NULL;
+  }
+  return ce;
+}
+
+
+/**
+ * Free a request that did not get an answer.
+ *
+ * @param request request to free
+ */
+static void
+free_request (struct Request *request)
+{
+  if (NULL != request->timeout_task)
+    GNUNET_SCHEDULER_cancel (request->timeout_task);
+  if (NULL != request->packet)
+    GNUNET_DNSPARSER_free_packet (request->packet);
+  GNUNET_free (request);
+}
+
+
+/**
+ * Cancel a pending GNS lookup and free the requests waiting
+ * for it during shutdown.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct PendingLookup` to free
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_pending_lookup (void *cls,
+                     const struct GNUNET_HashCode *key,
+                     void *value)
+{
+  struct PendingLookup *pl = value;
+  struct Request *request;
+
+  while (NULL != (request = pl->req_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pl->req_head,
+                                 pl->req_tail,
+                                 request);
+    free_request (request);
+  }
+  GNUNET_GNS_lookup_cancel (pl->lookup);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (pending_map,
+                                                       key,
+                                                       pl));
+  GNUNET_free (pl);
+  return GNUNET_OK;
+}
+
 
 /**
  * Task run on shutdown.  Cleans up everything.
@@ -176,6 +529,27 @@ static void
 do_shutdown (void *cls,
 	     const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  if (NULL != pending_map)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (pending_map,
+                                           &free_pending_lookup,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (pending_map);
+    pending_map = NULL;
+  }
+  if (NULL != cache_map)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (cache_map,
+                                           &free_cache_entry,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (cache_map);
+    cache_map = NULL;
+  }
+  if (NULL != cache_heap)
+  {
+    GNUNET_CONTAINER_heap_destroy (cache_heap);
+    cache_heap = NULL;
+  }
   if (NULL != t4)
     GNUNET_SCHEDULER_cancel (t4);
   if (NULL != t6)
@@ -221,14 +595,14 @@ do_shutdown (void *cls,
 static void
 send_response (struct Request *request)
 {
-  char *buf;
+  char buf[UINT16_MAX]; /* is this not too much? */
   size_t size;
 
   if (GNUNET_SYSERR ==
-      GNUNET_DNSPARSER_pack (request->packet,
-			     UINT16_MAX /* is this not too much? */,
-			     &buf,
-			     &size))
+      GNUNET_DNSPARSER_pack_to_buffer (request->packet,
+                                       buf,
+                                       sizeof (buf),
+                                       &size))
     {
       GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
 		  _("Failed to pack DNS response into UDP packet!\n"));
@@ -241,7 +615,6 @@ send_response (struct Request *request)
 					request->addr,
 					request->addr_len))
 	GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "sendto");
-      GNUNET_free (buf);
     }
   GNUNET_SCHEDULER_cancel (request->timeout_task);
   GNUNET_DNSPARSER_free_packet (request->packet);
@@ -260,12 +633,28 @@ do_timeout (void *cls,
 	    const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct Request *request = cls;
+  struct PendingLookup *pl;
 
   if (NULL != request->packet)
     GNUNET_DNSPARSER_free_packet (request->packet);
-  if (NULL != request->lookup)
-    GNUNET_GNS_lookup_cancel (request->lookup);
-  if (NULL != request->dns_lookup)
+  if (NULL != (pl = request->pl))
+  {
+    GNUNET_CONTAINER_DLL_remove (pl->req_head,
+                                 pl->req_tail,
+                                 request);
+    if (NULL == pl->req_head)
+    {
+      /* nobody else is waiting for this lookup */
+      GNUNET_GNS_lookup_cancel (pl->lookup);
+      GNUNET_assert (GNUNET_YES ==
+                     GNUNET_CONTAINER_multihashmap_remove (pending_map,
+                                                           &pl->key,
+                                                           pl));
+      GNUNET_free (pl);
+    }
+  }
+  if ( (NULL != request->dns_lookup) &&
+       (NULL != dns_stub) ) /* stopping the stub cancelled it */
     GNUNET_DNSSTUB_resolve_cancel (request->dns_lookup);
   GNUNET_free (request);
 }
@@ -293,23 +682,21 @@ dns_result_processor (void *cls,
 
 
 /**
- * Iterator called on obtained result for a GNS lookup.
+ * Answer a request with the given GNS records and clean up.
  *
- * @param cls closure
+ * @param request request to answer
  * @param rd_count number of records in @a rd
- * @param rd the records in reply
+ * @param rd the records, with absolute expiration times
  */
 static void
-result_processor (void *cls,
-		  uint32_t rd_count,
-		  const struct GNUNET_GNSRECORD_Data *rd)
+build_answer (struct Request *request,
+              unsigned int rd_count,
+              const struct GNUNET_GNSRECORD_Data *rd)
 {
-  struct Request *request = cls;
   struct GNUNET_DNSPARSER_Packet *packet;
-  uint32_t i;
+  unsigned int i;
   struct GNUNET_DNSPARSER_Record rec;
 
-  request->lookup = NULL;
   packet = request->packet;
   packet->flags.query_or_response = 1;
   packet->flags.return_code = GNUNET_TUN_DNS_RETURN_CODE_NO_ERROR;
@@ -376,6 +763,45 @@ result_processor (void *cls,
 }
 
 
+/**
+ * Iterator called on obtained result for a GNS lookup.  Answers all
+ * requests waiting for the lookup and caches the result.
+ *
+ * @param cls the `struct PendingLookup`
+ * @param rd_count number of records in @a rd
+ * @param rd the records in reply
+ */
+static void
+result_processor (void *cls,
+		  uint32_t rd_count,
+		  const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct PendingLookup *pl = cls;
+  struct Request *request;
+  struct CacheEntry *ce;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (pending_map,
+                                                       &pl->key,
+                                                       pl));
+  ce = create_cache_entry (&pl->key,
+                           rd_count,
+                           rd);
+  while (NULL != (request = pl->req_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pl->req_head,
+                                 pl->req_tail,
+                                 request);
+    request->pl = NULL;
+    build_answer (request,
+                  ce->rd_count,
+                  ce->rd);
+  }
+  GNUNET_free (pl);
+  cache_result (ce);
+}
+
+
 /**
  * Handle DNS request.
  *
@@ -394,6 +820,9 @@ handle_request (struct GNUNET_NETWORK_Handle *lsock,
 {
   struct Request *request;
   struct GNUNET_DNSPARSER_Packet *packet;
+  struct PendingLookup *pl;
+  struct CacheEntry *ce;
+  struct GNUNET_HashCode key;
   char *name;
   size_t name_len;
   int type;
@@ -472,18 +901,52 @@ handle_request (struct GNUNET_NETWORK_Handle *lsock,
   }
   if (GNUNET_YES == use_gns)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Calling GNS on `%s'\n",
-		name);
     type = packet->queries[0].type;
-    request->lookup = GNUNET_GNS_lookup (gns,
-					 name,
-					 &my_zone,
-					 type,
-					 GNUNET_NO,
-					 NULL /* no shorten */,
-					 &result_processor,
-					 request);
+    get_lookup_key (name, type, &key);
+    if (NULL != (ce = get_cached_result (&key)))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Answering request for `%s' from cache\n",
+                  name);
+      build_answer (request,
+                    ce->rd_count,
+                    ce->rd);
+      GNUNET_free (name);
+      return;
+    }
+    pl = GNUNET_CONTAINER_multihashmap_get (pending_map,
+                                            &key);
+    if (NULL == pl)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Calling GNS on `%s'\n",
+                  name);
+      pl = GNUNET_new (struct PendingLookup);
+      pl->key = key;
+      pl->lookup = GNUNET_GNS_lookup (gns,
+                                      name,
+                                      &my_zone,
+                                      type,
+                                      GNUNET_NO,
+                                      NULL /* no shorten */,
+                                      &result_processor,
+                                      pl);
+      GNUNET_assert (GNUNET_OK ==
+                     GNUNET_CONTAINER_multihashmap_put (pending_map,
+                                                        &pl->key,
+                                                        pl,
+                                                        GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    }
+    else
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Joining pending GNS lookup for `%s'\n",
+                  name);
+    }
+    request->pl = pl;
+    GNUNET_CONTAINER_DLL_insert_tail (pl->req_head,
+                                      pl->req_tail,
+                                      request);
   }
   else
   {
@@ -504,88 +967,95 @@ handle_request (struct GNUNET_NETWORK_Handle *lsock,
 
 
 /**
- * Task to read IPv4 DNS packets.
+ * Task to read DNS packets.  Reads all pending datagrams in
+ * batches of up to #RECV_BATCH_SIZE per system call.
  *
- * @param cls the 'listen_socket4'
+ * @param cls the listen socket that is ready
  * @param tc scheduler context
  */
 static void
-read_dns4 (void *cls,
-	   const struct GNUNET_SCHEDULER_TaskContext *tc)
+read_dns (void *cls,
+	  const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct sockaddr_in v4;
-  socklen_t addrlen;
-  ssize_t size;
-
-  GNUNET_assert (listen_socket4 == cls);
-  t4 = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
-				      listen_socket4,
-				      &read_dns4,
-				      listen_socket4);
+  static char bufs[RECV_BATCH_SIZE][MAX_QUERY_SIZE];
+  struct GNUNET_NETWORK_Handle *lsock = cls;
+  struct GNUNET_NETWORK_Datagram dgrams[RECV_BATCH_SIZE];
+  struct sockaddr_storage addrs[RECV_BATCH_SIZE];
+  struct GNUNET_SCHEDULER_Task *t;
+  unsigned int i;
+  int ret;
+
+  GNUNET_assert ( (listen_socket4 == lsock) ||
+                  (listen_socket6 == lsock) );
+  t = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                     lsock,
+                                     &read_dns,
+                                     lsock);
+  if (listen_socket4 == lsock)
+    t4 = t;
+  else
+    t6 = t;
   if (0 == (GNUNET_SCHEDULER_REASON_READ_READY & tc->reason))
     return; /* shutdown? */
-  size = GNUNET_NETWORK_socket_recvfrom_amount (listen_socket4);
-  if (0 > size)
+  do
+  {
+    for (i=0;i<RECV_BATCH_SIZE;i++)
     {
-      GNUNET_break (0);
-      return; /* read error!? */
+      dgrams[i].buffer = bufs[i];
+      dgrams[i].length = sizeof (bufs[i]);
+      dgrams[i].addr = (struct sockaddr *) &addrs[i];
+      dgrams[i].addrlen = sizeof (addrs[i]);
+      dgrams[i].segment_size = 0;
     }
-  {
-    char buf[size];
-
-    addrlen = sizeof (v4);
-    GNUNET_break (size ==
-		  GNUNET_NETWORK_socket_recvfrom (listen_socket4,
-						  buf,
-						  size,
-						  (struct sockaddr *) &v4,
-						  &addrlen));
-    handle_request (listen_socket4, &v4, addrlen,
-		    buf, size);
+    ret = GNUNET_NETWORK_socket_recvfrom_batch (lsock,
+                                                dgrams,
+                                                RECV_BATCH_SIZE);
+    if (GNUNET_SYSERR == ret)
+    {
+      if ( (EAGAIN != errno) &&
+           (EWOULDBLOCK != errno) )
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "recvmmsg");
+      return;
+    }
+    for (i=0;i<(unsigned int) ret;i++)
+      handle_request (lsock,
+                      dgrams[i].addr,
+                      dgrams[i].addrlen,
+                      dgrams[i].buffer,
+                      dgrams[i].length);
   }
+  while (RECV_BATCH_SIZE == ret);
 }
 
 
 /**
- * Task to read IPv6 DNS packets.
+ * Set SO_REUSEPORT on a listen socket if requested, so that several
+ * dns2gns processes can share the port and the kernel spreads the
+ * requests over them.
  *
- * @param cls the 'listen_socket6'
- * @param tc scheduler context
+ * @param lsock socket to configure (not yet bound)
  */
 static void
-read_dns6 (void *cls,
-	   const struct GNUNET_SCHEDULER_TaskContext *tc)
+set_reuse_port (struct GNUNET_NETWORK_Handle *lsock)
 {
-  struct sockaddr_in6 v6;
-  socklen_t addrlen;
-  ssize_t size;
-
-  GNUNET_assert (listen_socket6 == cls);
-  t6 = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
-				      listen_socket6,
-				      &read_dns6,
-				      listen_socket6);
-  if (0 == (GNUNET_SCHEDULER_REASON_READ_READY & tc->reason))
-    return; /* shutdown? */
-  size = GNUNET_NETWORK_socket_recvfrom_amount (listen_socket6);
-  if (0 > size)
-    {
-      GNUNET_break (0);
-      return; /* read error!? */
-    }
+  if (GNUNET_YES != reuse_port)
+    return;
+#ifdef SO_REUSEPORT
   {
-    char buf[size];
-
-    addrlen = sizeof (v6);
-    GNUNET_break (size ==
-		  GNUNET_NETWORK_socket_recvfrom (listen_socket6,
-						  buf,
-						  size,
-						  (struct sockaddr *) &v6,
-						  &addrlen));
-    handle_request (listen_socket6, &v6, addrlen,
-		    buf, size);
+    const int on = 1;
+
+    if (GNUNET_OK !=
+        GNUNET_NETWORK_socket_setsockopt (lsock,
+                                          SOL_SOCKET,
+                                          SO_REUSEPORT,
+                                          &on,
+                                          sizeof (on)))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "setsockopt");
   }
+#else
+  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+              _("SO_REUSEPORT is not supported on this platform\n"));
+#endif
 }
 
 
@@ -620,6 +1090,7 @@ run_dnsd ()
       v4.sin_len = sizeof (v4);
 #endif
       v4.sin_port = htons (listen_port);
+      set_reuse_port (listen_socket4);
       if (GNUNET_OK !=
 	  GNUNET_NETWORK_socket_bind (listen_socket4,
 				      (struct sockaddr *) &v4,
@@ -643,6 +1114,7 @@ run_dnsd ()
       v6.sin6_len = sizeof (v6);
 #endif
       v6.sin6_port = htons (listen_port);
+      set_reuse_port (listen_socket6);
       if (GNUNET_OK !=
 	  GNUNET_NETWORK_socket_bind (listen_socket6,
 				      (struct sockaddr *) &v6,
@@ -662,15 +1134,20 @@ run_dnsd ()
       dns_stub = NULL;
       return;
     }
+  pending_map = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                      GNUNET_NO);
+  cache_map = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                    GNUNET_NO);
+  cache_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   if (NULL != listen_socket4)
     t4 = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
 					listen_socket4,
-					&read_dns4,
+					&read_dns,
 					listen_socket4);
   if (NULL != listen_socket6)
     t6 = GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
 					listen_socket6,
-					&read_dns6,
+					&read_dns,
 					listen_socket6);
 
 }
@@ -785,6 +1262,9 @@ main (int argc,
     {'p', "port", "UDPPORT",
       gettext_noop ("UDP port to listen on for inbound DNS requests; default: 2853"), 1,
       &GNUNET_GETOPT_set_uint, &listen_port},
+    {'r', "reuseport", NULL,
+      gettext_noop ("Allow several processes to listen on the same UDP port (SO_REUSEPORT)"), 0,
+      &GNUNET_GETOPT_set_one, &reuse_port},
     {'z', "zone", "PUBLICKEY",
       gettext_noop ("Public key of the GNS zone to use (overrides default)"), 1,
       &GNUNET_GETOPT_set_string, &gns_zone_str},
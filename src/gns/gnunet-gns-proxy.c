@@ -98,6 +98,24 @@
  */
 #define HTTP_HANDSHAKE_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 15)
 
+/**
+ * How many idle connections to origin servers does cURL keep open
+ * for reuse by later requests?
+ */
+#define MAX_CACHED_CONNECTIONS 64
+
+/**
+ * How many connections do we open at most to the same origin?
+ * Further requests wait for (or are multiplexed over) these.
+ */
+#define MAX_CONNECTIONS_PER_ORIGIN 8
+
+/**
+ * How many generated certificates do we keep for reuse after the
+ * MHD daemon for their domain was stopped?
+ */
+#define MAX_CERT_CACHE_SIZE 64
+
 
 /**
  * Log curl error.
@@ -314,6 +332,27 @@ struct ProxyCA
  */
 struct ProxyGNSCertificate
 {
+  /**
+   * DLL of cached certificates, most recently used first.
+   */
+  struct ProxyGNSCertificate *prev;
+
+  /**
+   * DLL of cached certificates, most recently used first.
+   */
+  struct ProxyGNSCertificate *next;
+
+  /**
+   * The domain the certificate was generated for.
+   */
+  char *domain;
+
+  /**
+   * Number of references to this certificate (from the cache and
+   * from MHD daemons using it).
+   */
+  unsigned int rc;
+
   /**
    * The certificate as PEM
    */
@@ -327,6 +366,39 @@ struct ProxyGNSCertificate
 
 
 
+/**
+ * A certificate that is being generated in the crypto offload pool.
+ */
+struct CertificateJob
+{
+  /**
+   * DLL of certificate jobs.
+   */
+  struct CertificateJob *prev;
+
+  /**
+   * DLL of certificate jobs.
+   */
+  struct CertificateJob *next;
+
+  /**
+   * The domain to generate the certificate for.
+   */
+  char *domain;
+
+  /**
+   * The generated certificate, set by the worker.
+   */
+  struct ProxyGNSCertificate *pgc;
+
+  /**
+   * Handle for the offloaded generation.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+};
+
+
 /**
  * A structure for all running Httpds
  */
@@ -492,6 +564,12 @@ struct Socks5Request
    */
   struct MhdHttpList *hd;
 
+  /**
+   * Generation of the certificate for @e domain we are waiting
+   * for, NULL for none.
+   */
+  struct CertificateJob *cert_job;
+
   /**
    * MHD response object for this request.
    */
@@ -619,6 +697,42 @@ static struct GNUNET_SCHEDULER_Task * curl_download_task;
  */
 static CURLM *curl_multi;
 
+/**
+ * cURL share handle, so that TLS sessions with origin servers
+ * survive the easy handles of individual requests.
+ */
+static CURLSH *curl_share;
+
+/**
+ * DLL of generated certificates, most recently used first.
+ */
+static struct ProxyGNSCertificate *cert_head;
+
+/**
+ * DLL of generated certificates, most recently used first.
+ */
+static struct ProxyGNSCertificate *cert_tail;
+
+/**
+ * Number of entries in the #cert_head DLL.
+ */
+static unsigned int cert_cache_size;
+
+/**
+ * DLL of certificates being generated.
+ */
+static struct CertificateJob *cj_head;
+
+/**
+ * DLL of certificates being generated.
+ */
+static struct CertificateJob *cj_tail;
+
+/**
+ * Directory of the on-disk certificate cache, NULL for none.
+ */
+static char *cert_cache_dir;
+
 /**
  * Handle to the GNS service
  */
@@ -670,6 +784,11 @@ static int do_shorten;
  */
 static struct ProxyCA proxy_ca;
 
+/**
+ * The private key of the CA as PEM (used by all our certificates).
+ */
+static char proxy_ca_key_pem[MAX_PEM_SIZE];
+
 /**
  * Response we return on cURL failures.
  */
@@ -737,6 +856,9 @@ cleanup_s5r (struct Socks5Request *s5r)
     GNUNET_SCHEDULER_cancel (s5r->wtask);
   if (NULL != s5r->gns_lookup)
     GNUNET_GNS_lookup_cancel (s5r->gns_lookup);
+  /* a pending certificate job is left running, the certificate
+     will still be cached */
+  s5r->cert_job = NULL;
   if (NULL != s5r->sock)
   {
     if (SOCKS5_SOCKET_WITH_MHD <= s5r->state)
@@ -1035,8 +1157,9 @@ curl_check_hdr (void *buffer, size_t size, size_t nmemb, void *cls)
 					     cors_hdr));
       GNUNET_free (cors_hdr);
     }
-    /* force connection to be closed after each request, as we
-       do not support HTTP pipelining (yet, FIXME!) */
+    /* force connection to the browser to be closed after each
+       request, as each SOCKS5 request carries one HTTP request;
+       (only) the connections to the origins are kept alive */
     GNUNET_break (MHD_YES ==
 		  MHD_add_response_header (s5r->response,
 					   MHD_HTTP_HEADER_CONNECTION,
@@ -1058,6 +1181,14 @@ curl_check_hdr (void *buffer, size_t size, size_t nmemb, void *cls)
   }
   if (' ' == *hdr_val)
     hdr_val++;
+  /* connection management with the origin is our business (we keep
+     those connections open), do not forward hop-by-hop headers */
+  if ( (0 == strcasecmp (hdr_type, MHD_HTTP_HEADER_CONNECTION)) ||
+       (0 == strcasecmp (hdr_type, "Keep-Alive")) )
+  {
+    GNUNET_free (ndup);
+    return bytes;
+  }
 
   /* custom logic for certain header types */
   new_cookie_hdr = NULL;
@@ -1421,9 +1552,9 @@ curl_task_download (void *cls,
 /**
  * Read HTTP request header field from the request.  Copies the fields
  * over to the 'headers' that will be given to curl.  However, 'Host'
- * is substituted with the LEHO if present.  We also change the
- * 'Connection' header value to "close" as the proxy does not support
- * pipelining.
+ * is substituted with the LEHO if present.  Hop-by-hop headers
+ * ('Connection', 'Keep-Alive') are dropped, as cURL manages the
+ * (persistent) connections to the origin itself.
  *
  * @param cls our `struct Socks5Request`
  * @param kind value kind
@@ -1443,8 +1574,10 @@ con_val_iter (void *cls,
   if ( (0 == strcasecmp (MHD_HTTP_HEADER_HOST, key)) &&
        (NULL != s5r->leho) )
     value = s5r->leho;
-  if (0 == strcasecmp (MHD_HTTP_HEADER_CONNECTION, key))
-    value = "Close";
+  if ( (0 == strcasecmp (MHD_HTTP_HEADER_CONNECTION, key)) ||
+       (0 == strcasecmp ("Keep-Alive", key)) ||
+       (0 == strcasecmp ("Proxy-Connection", key)) )
+    return MHD_YES;
   GNUNET_asprintf (&hdr,
 		   "%s: %s",
 		   key,
@@ -1568,6 +1701,18 @@ create_response (void *cls,
     curl_easy_setopt (s5r->curl, CURLOPT_NOSIGNAL, 1L);
     curl_easy_setopt (s5r->curl, CURLOPT_PRIVATE, s5r);
     curl_easy_setopt (s5r->curl, CURLOPT_VERBOSE, 0);
+    /* connections to the origin are kept in the connection cache of
+       'curl_multi' (keyed by host and port) and reused by later
+       requests; TLS sessions are shared via 'curl_share' */
+    curl_easy_setopt (s5r->curl, CURLOPT_SHARE, curl_share);
+#if LIBCURL_VERSION_NUM >= 0x071900
+    curl_easy_setopt (s5r->curl, CURLOPT_TCP_KEEPALIVE, 1L);
+#endif
+#ifdef CURLPIPE_MULTIPLEX
+    /* prefer waiting for an HTTP/2 connection to the origin that we
+       can multiplex over to opening another one */
+    curl_easy_setopt (s5r->curl, CURLOPT_PIPEWAIT, 1L);
+#endif
     /**
      * Pre-populate cache to resolve Hostname.
      * This is necessary as the DNS name in the CURLOPT_URL is used
@@ -1644,7 +1789,16 @@ create_response (void *cls,
     }
     else if (0 == strcasecmp (ver, MHD_HTTP_VERSION_1_1))
     {
+#if LIBCURL_VERSION_NUM >= 0x072f00
+      /* MHD speaks HTTP/1.1 to the browser, but towards TLS origins we
+	 can use HTTP/2 (negotiated via ALPN) to multiplex requests */
+      curl_easy_setopt (s5r->curl, CURLOPT_HTTP_VERSION,
+			(HTTPS_PORT == s5r->port)
+			? CURL_HTTP_VERSION_2TLS
+			: CURL_HTTP_VERSION_1_1);
+#else
       curl_easy_setopt (s5r->curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+#endif
     }
     else
     {
@@ -1810,7 +1964,8 @@ kill_httpd (struct MhdHttpList *hd)
     GNUNET_SCHEDULER_cancel (hd->httpd_task);
     hd->httpd_task = NULL;
   }
-  GNUNET_free_non_null (hd->proxy_cert);
+  if (NULL != hd->proxy_cert)
+    release_gns_certificate (hd->proxy_cert);
   if (hd == httpd)
     httpd = NULL;
   GNUNET_free (hd);
@@ -2041,7 +2196,9 @@ load_cert_from_file (gnutls_x509_crt_t crt,
 
 
 /**
- * Generate new certificate for specific name
+ * Generate new certificate for specific name.  Runs in a worker
+ * thread of the crypto offload pool, so must not log or touch any
+ * state other than the (read-only) #proxy_ca.
  *
  * @param name the subject name to generate a cert for
  * @return a struct holding the PEM data, NULL on error
@@ -2050,18 +2207,18 @@ static struct ProxyGNSCertificate *
 generate_gns_certificate (const char *name)
 {
   unsigned int serial;
-  size_t key_buf_size;
   size_t cert_buf_size;
   gnutls_x509_crt_t request;
   time_t etime;
-  struct tm *tm_data;
   struct ProxyGNSCertificate *pgc;
 
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Generating TLS/SSL certificate for `%s'\n",
-	      name);
-  GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_init (&request));
-  GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_set_key (request, proxy_ca.key));
+  if (GNUTLS_E_SUCCESS != gnutls_x509_crt_init (&request))
+    return NULL;
+  if (GNUTLS_E_SUCCESS != gnutls_x509_crt_set_key (request, proxy_ca.key))
+  {
+    gnutls_x509_crt_deinit (request);
+    return NULL;
+  }
   pgc = GNUNET_new (struct ProxyGNSCertificate);
   gnutls_x509_crt_set_dn_by_oid (request, GNUTLS_OID_X520_COUNTRY_NAME,
                                  0, "ZZ", 2);
@@ -2069,33 +2226,280 @@ generate_gns_certificate (const char *name)
                                  0, "GNU Name System", 4);
   gnutls_x509_crt_set_dn_by_oid (request, GNUTLS_OID_X520_COMMON_NAME,
                                  0, name, strlen (name));
-  GNUNET_break (GNUTLS_E_SUCCESS == gnutls_x509_crt_set_version (request, 3));
+  gnutls_x509_crt_set_version (request, 3);
   gnutls_rnd (GNUTLS_RND_NONCE, &serial, sizeof (serial));
   gnutls_x509_crt_set_serial (request,
 			      &serial,
 			      sizeof (serial));
   etime = time (NULL);
-  tm_data = localtime (&etime);
   gnutls_x509_crt_set_activation_time (request,
 				       etime);
-  tm_data->tm_year++;
-  etime = mktime (tm_data);
+  /* valid for a year (localtime() is not thread-safe) */
+  etime += 365 * 24 * 60 * 60;
   gnutls_x509_crt_set_expiration_time (request,
 				       etime);
   gnutls_x509_crt_sign (request,
 			proxy_ca.cert,
 			proxy_ca.key);
-  key_buf_size = sizeof (pgc->key);
   cert_buf_size = sizeof (pgc->cert);
-  gnutls_x509_crt_export (request, GNUTLS_X509_FMT_PEM,
-                          pgc->cert, &cert_buf_size);
-  gnutls_x509_privkey_export (proxy_ca.key, GNUTLS_X509_FMT_PEM,
-			      pgc->key, &key_buf_size);
+  if (GNUTLS_E_SUCCESS !=
+      gnutls_x509_crt_export (request, GNUTLS_X509_FMT_PEM,
+                              pgc->cert, &cert_buf_size))
+  {
+    gnutls_x509_crt_deinit (request);
+    GNUNET_free (pgc);
+    return NULL;
+  }
+  /* all our certificates use the key of the CA */
+  memcpy (pgc->key, proxy_ca_key_pem, sizeof (pgc->key));
   gnutls_x509_crt_deinit (request);
   return pgc;
 }
 
 
+/**
+ * Drop a reference to a certificate, freeing it if it was the last.
+ *
+ * @param pgc certificate to release
+ */
+static void
+release_gns_certificate (struct ProxyGNSCertificate *pgc)
+{
+  GNUNET_assert (pgc->rc > 0);
+  if (0 != --pgc->rc)
+    return;
+  GNUNET_free (pgc->domain);
+  GNUNET_free (pgc);
+}
+
+
+/**
+ * Remove the least recently used certificate from the cache.
+ */
+static void
+expire_gns_certificate ()
+{
+  struct ProxyGNSCertificate *pgc;
+
+  pgc = cert_tail;
+  GNUNET_CONTAINER_DLL_remove (cert_head,
+			       cert_tail,
+			       pgc);
+  cert_cache_size--;
+  release_gns_certificate (pgc);
+}
+
+
+/**
+ * Add a certificate to the (in-memory) cache.
+ *
+ * @param pgc freshly generated or loaded certificate
+ * @param name the subject name of @a pgc
+ */
+static void
+cache_gns_certificate (struct ProxyGNSCertificate *pgc,
+		       const char *name)
+{
+  pgc->domain = GNUNET_strdup (name);
+  pgc->rc = 1; /* for the cache */
+  if (cert_cache_size >= MAX_CERT_CACHE_SIZE)
+    expire_gns_certificate ();
+  cert_cache_size++;
+  GNUNET_CONTAINER_DLL_insert (cert_head,
+			       cert_tail,
+			       pgc);
+}
+
+
+/**
+ * Compute the name of the file in the on-disk cache for the
+ * certificate of a name.
+ *
+ * @param name the subject name
+ * @return file name, NULL if we have no on-disk cache
+ */
+static char *
+get_certificate_filename (const char *name)
+{
+  struct GNUNET_HashCode hc;
+  struct GNUNET_CRYPTO_HashAsciiEncoded enc;
+  char *fn;
+
+  if (NULL == cert_cache_dir)
+    return NULL;
+  GNUNET_CRYPTO_hash (name, strlen (name), &hc);
+  GNUNET_CRYPTO_hash_to_enc (&hc, &enc);
+  GNUNET_asprintf (&fn,
+		   "%s%s%s.pem",
+		   cert_cache_dir,
+		   DIR_SEPARATOR_STR,
+		   (const char *) &enc);
+  return fn;
+}
+
+
+/**
+ * Try to load the certificate for a name from the on-disk cache.
+ * Only certificates that were signed by our current CA and that are
+ * valid for at least another day are used.
+ *
+ * @param name the subject name
+ * @return NULL if we have no usable certificate on disk
+ */
+static struct ProxyGNSCertificate *
+load_gns_certificate (const char *name)
+{
+  struct ProxyGNSCertificate *pgc;
+  gnutls_x509_crt_t crt;
+  gnutls_datum_t datum;
+  unsigned int status;
+  ssize_t ret;
+  char *fn;
+
+  if (NULL == (fn = get_certificate_filename (name)))
+    return NULL;
+  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
+  {
+    GNUNET_free (fn);
+    return NULL;
+  }
+  pgc = GNUNET_new (struct ProxyGNSCertificate);
+  ret = GNUNET_DISK_fn_read (fn, pgc->cert, sizeof (pgc->cert) - 1);
+  GNUNET_free (fn);
+  if (ret <= 0)
+  {
+    GNUNET_free (pgc);
+    return NULL;
+  }
+  pgc->cert[ret] = '\0';
+  if (GNUTLS_E_SUCCESS != gnutls_x509_crt_init (&crt))
+  {
+    GNUNET_free (pgc);
+    return NULL;
+  }
+  datum.data = (unsigned char *) pgc->cert;
+  datum.size = (unsigned int) ret;
+  status = 1;
+  if ( (GNUTLS_E_SUCCESS !=
+	gnutls_x509_crt_import (crt, &datum, GNUTLS_X509_FMT_PEM)) ||
+       (GNUTLS_E_SUCCESS !=
+	gnutls_x509_crt_verify (crt, &proxy_ca.cert, 1, 0, &status)) ||
+       (0 != status) ||
+       (gnutls_x509_crt_get_expiration_time (crt) < time (NULL) + 24 * 60 * 60) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Ignoring stale cached certificate for `%s'\n",
+		name);
+    gnutls_x509_crt_deinit (crt);
+    GNUNET_free (pgc);
+    return NULL;
+  }
+  gnutls_x509_crt_deinit (crt);
+  memcpy (pgc->key, proxy_ca_key_pem, sizeof (pgc->key));
+  return pgc;
+}
+
+
+/**
+ * Write a certificate to the on-disk cache.
+ *
+ * @param pgc certificate to store
+ * @param name the subject name of @a pgc
+ */
+static void
+store_gns_certificate (const struct ProxyGNSCertificate *pgc,
+		       const char *name)
+{
+  char *fn;
+
+  if (NULL == (fn = get_certificate_filename (name)))
+    return;
+  if ( (GNUNET_OK != GNUNET_DISK_directory_create_for_file (fn)) ||
+       (strlen (pgc->cert) !=
+	GNUNET_DISK_fn_write (fn,
+			      pgc->cert,
+			      strlen (pgc->cert),
+			      GNUNET_DISK_PERM_USER_READ |
+			      GNUNET_DISK_PERM_USER_WRITE)) )
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+			      "write",
+			      fn);
+  GNUNET_free (fn);
+}
+
+
+/**
+ * Get a certificate for a specific name from the in-memory or the
+ * on-disk cache.
+ *
+ * @param name the subject name to get a cert for
+ * @return a struct holding the PEM data, NULL if we have none; to be
+ *         released with #release_gns_certificate()
+ */
+static struct ProxyGNSCertificate *
+get_cached_gns_certificate (const char *name)
+{
+  struct ProxyGNSCertificate *pgc;
+
+  for (pgc = cert_head; NULL != pgc; pgc = pgc->next)
+    if (0 == strcmp (pgc->domain, name))
+      break;
+  if (NULL != pgc)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Reusing TLS/SSL certificate for `%s'\n",
+		name);
+    GNUNET_CONTAINER_DLL_remove (cert_head,
+				 cert_tail,
+				 pgc);
+    GNUNET_CONTAINER_DLL_insert (cert_head,
+				 cert_tail,
+				 pgc);
+  }
+  else
+  {
+    pgc = load_gns_certificate (name);
+    if (NULL == pgc)
+      return NULL;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Loaded TLS/SSL certificate for `%s' from disk\n",
+		name);
+    cache_gns_certificate (pgc, name);
+  }
+  pgc->rc++;
+  return pgc;
+}
+
+
+/**
+ * Get a certificate for a specific name, from the cache if we
+ * generated one before, otherwise generate (and cache) it right
+ * away.
+ *
+ * @param name the subject name to get a cert for
+ * @return a struct holding the PEM data, NULL on error; to be
+ *         released with #release_gns_certificate()
+ */
+static struct ProxyGNSCertificate *
+get_gns_certificate (const char *name)
+{
+  struct ProxyGNSCertificate *pgc;
+
+  if (NULL != (pgc = get_cached_gns_certificate (name)))
+    return pgc;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Generating TLS/SSL certificate for `%s'\n",
+	      name);
+  pgc = generate_gns_certificate (name);
+  if (NULL == pgc)
+    return NULL;
+  store_gns_certificate (pgc, name);
+  cache_gns_certificate (pgc, name);
+  pgc->rc++;
+  return pgc;
+}
+
+
 /**
  * Function called by MHD with errors, suppresses them all.
  *
@@ -2136,7 +2540,9 @@ lookup_ssl_httpd (const char* domain)
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Starting fresh MHD HTTPS instance for domain `%s'\n",
 	      domain);
-  pgc = generate_gns_certificate (domain);
+  pgc = get_gns_certificate (domain);
+  if (NULL == pgc)
+    return NULL;
   hd = GNUNET_new (struct MhdHttpList);
   hd->is_ssl = GNUNET_YES;
   hd->domain = GNUNET_strdup (domain);
@@ -2154,7 +2560,8 @@ lookup_ssl_httpd (const char* domain)
 				 MHD_OPTION_END);
   if (NULL == hd->daemon)
   {
-    GNUNET_free (pgc);
+    release_gns_certificate (pgc);
+    GNUNET_free (hd->domain);
     GNUNET_free (hd);
     return NULL;
   }
@@ -2184,6 +2591,142 @@ timeout_s5r_handshake (void *cls,
 }
 
 
+/**
+ * We're done with the Socks5 protocol, now we need to pass the
+ * connection data through to the final destination, either
+ * direct (if the protocol might not be HTTP), or via MHD
+ * (if the port looks like it should be HTTP).
+ *
+ * @param s5r socks request that has reached the final stage
+ */
+static void
+setup_data_transfer (struct Socks5Request *s5r);
+
+
+/**
+ * Generate a certificate in a worker thread.
+ *
+ * @param cls the `struct CertificateJob`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+generate_certificate_work (void *cls)
+{
+  struct CertificateJob *cj = cls;
+
+  cj->pgc = generate_gns_certificate (cj->domain);
+  return (NULL == cj->pgc) ? GNUNET_SYSERR : GNUNET_OK;
+}
+
+
+/**
+ * Free a certificate job.
+ *
+ * @param cj job to free
+ */
+static void
+free_certificate_job (struct CertificateJob *cj)
+{
+  GNUNET_CONTAINER_DLL_remove (cj_head,
+			       cj_tail,
+			       cj);
+  GNUNET_free (cj->domain);
+  GNUNET_free (cj);
+}
+
+
+/**
+ * A certificate was generated in the crypto offload pool.  Cache it
+ * and continue with the requests that were waiting for it.
+ *
+ * @param cls the `struct CertificateJob`
+ * @param result #GNUNET_OK on success
+ */
+static void
+certificate_ready (void *cls,
+		   int result)
+{
+  struct CertificateJob *cj = cls;
+  struct Socks5Request *s5r;
+  struct Socks5Request *next;
+
+  cj->job = NULL;
+  if (GNUNET_OK == result)
+  {
+    store_gns_certificate (cj->pgc, cj->domain);
+    cache_gns_certificate (cj->pgc, cj->domain);
+    cj->pgc = NULL;
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Failed to generate certificate for `%s'\n"),
+		cj->domain);
+  }
+  for (s5r = s5r_head; NULL != s5r; s5r = next)
+  {
+    next = s5r->next;
+    if (s5r->cert_job != cj)
+      continue;
+    s5r->cert_job = NULL;
+    if (GNUNET_OK == result)
+      setup_data_transfer (s5r);
+    else
+      cleanup_s5r (s5r);
+  }
+  free_certificate_job (cj);
+}
+
+
+/**
+ * Make sure we have a certificate for the domain of an HTTPS
+ * request, generating one in the crypto offload pool if needed, so
+ * that signing does not stall other connections.
+ *
+ * @param s5r request for an HTTPS site
+ * @return #GNUNET_NO if we have a certificate (or daemon) for the
+ *         domain already, #GNUNET_YES if @a s5r has to wait for
+ *         the certificate to be generated
+ */
+static int
+wait_for_certificate (struct Socks5Request *s5r)
+{
+  struct MhdHttpList *hd;
+  struct ProxyGNSCertificate *pgc;
+  struct CertificateJob *cj;
+
+  for (hd = mhd_httpd_head; NULL != hd; hd = hd->next)
+    if ( (NULL != hd->domain) &&
+	 (0 == strcmp (hd->domain, s5r->domain)) )
+      return GNUNET_NO;
+  if (NULL != (pgc = get_cached_gns_certificate (s5r->domain)))
+  {
+    release_gns_certificate (pgc);
+    return GNUNET_NO;
+  }
+  for (cj = cj_head; NULL != cj; cj = cj->next)
+    if (0 == strcmp (cj->domain, s5r->domain))
+      break;
+  if (NULL == cj)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Generating TLS/SSL certificate for `%s'\n",
+		s5r->domain);
+    cj = GNUNET_new (struct CertificateJob);
+    cj->domain = GNUNET_strdup (s5r->domain);
+    GNUNET_CONTAINER_DLL_insert (cj_head,
+				 cj_tail,
+				 cj);
+    cj->job = GNUNET_CRYPTO_offload (&generate_certificate_work,
+				     cj,
+				     &certificate_ready,
+				     cj);
+  }
+  s5r->cert_job = cj;
+  return GNUNET_YES;
+}
+
+
 /**
  * We're done with the Socks5 protocol, now we need to pass the
  * connection data through to the final destination, either
@@ -2203,6 +2746,9 @@ setup_data_transfer (struct Socks5Request *s5r)
   switch (s5r->port)
   {
   case HTTPS_PORT:
+    if ( (NULL != s5r->domain) &&
+	 (GNUNET_YES == wait_for_certificate (s5r)) )
+      return; /* continued in #certificate_ready() */
     hd = lookup_ssl_httpd (s5r->domain);
     if (NULL == hd)
     {
@@ -2806,6 +3352,24 @@ do_shutdown (void *cls,
     curl_multi_cleanup (curl_multi);
     curl_multi = NULL;
   }
+  if (NULL != curl_share)
+  {
+    curl_share_cleanup (curl_share);
+    curl_share = NULL;
+  }
+  while (NULL != cj_head)
+  {
+    struct CertificateJob *cj = cj_head;
+
+    if (NULL != cj->job)
+      GNUNET_CRYPTO_offload_cancel (cj->job);
+    GNUNET_free_non_null (cj->pgc);
+    free_certificate_job (cj);
+  }
+  while (NULL != cert_head)
+    expire_gns_certificate ();
+  GNUNET_free_non_null (cert_cache_dir);
+  cert_cache_dir = NULL;
   if (NULL != gns_handle)
   {
     GNUNET_GNS_disconnect (gns_handle);
@@ -3091,6 +3655,28 @@ run (void *cls, char *const *args, const char *cfgfile,
                 "Failed to create cURL multi handle!\n");
     return;
   }
+  /* keep connections to origins open for reuse, with a per-origin
+     limit; multiplex requests over HTTP/2 where the origin offers it */
+  curl_multi_setopt (curl_multi, CURLMOPT_MAXCONNECTS,
+		     (long) MAX_CACHED_CONNECTIONS);
+#if LIBCURL_VERSION_NUM >= 0x071e00
+  curl_multi_setopt (curl_multi, CURLMOPT_MAX_HOST_CONNECTIONS,
+		     (long) MAX_CONNECTIONS_PER_ORIGIN);
+#endif
+#ifdef CURLPIPE_MULTIPLEX
+  curl_multi_setopt (curl_multi, CURLMOPT_PIPELINING,
+		     (long) CURLPIPE_MULTIPLEX);
+#endif
+  if (NULL == (curl_share = curl_share_init ()))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Failed to create cURL share handle!\n");
+    curl_multi_cleanup (curl_multi);
+    curl_multi = NULL;
+    return;
+  }
+  curl_share_setopt (curl_share, CURLSHOPT_SHARE,
+		     CURL_LOCK_DATA_SSL_SESSION);
   cafile = cafile_opt;
   if (NULL == cafile)
   {
@@ -3125,6 +3711,18 @@ run (void *cls, char *const *args, const char *cfgfile,
     return;
   }
   GNUNET_free_non_null (cafile_cfg);
+  {
+    size_t key_buf_size = sizeof (proxy_ca_key_pem);
+
+    GNUNET_break (GNUTLS_E_SUCCESS ==
+		  gnutls_x509_privkey_export (proxy_ca.key, GNUTLS_X509_FMT_PEM,
+					      proxy_ca_key_pem, &key_buf_size));
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg, "gns-proxy",
+					       "CERT_CACHE",
+					       &cert_cache_dir))
+    cert_cache_dir = NULL; /* no on-disk cache */
   if (NULL == (gns_handle = GNUNET_GNS_connect (cfg)))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
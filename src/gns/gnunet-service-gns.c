@@ -37,6 +37,7 @@
 #include "gnunet-service-gns_resolver.h"
 #include "gnunet-service-gns_shorten.h"
 #include "gnunet-service-gns_interceptor.h"
+#include "gnunet-service-gns_publisher.h"
 #include "gnunet_protocols.h"
 
 /**
@@ -237,6 +238,13 @@ static struct GNUNET_SCHEDULER_Task * zone_publish_task;
  */
 static int first_zone_iteration;
 
+/**
+ * #GNUNET_YES if we only republish blocks when they are about to
+ * expire (and on changes) instead of iterating over the zone
+ * periodically.
+ */
+static int differential_publish;
+
 /**
  * #GNUNET_YES if ipv6 is supported
  */
@@ -294,6 +302,7 @@ shutdown_task (void *cls,
   }
   GNS_resolver_done ();
   GNS_shorten_done ();
+  GNS_publisher_done ();
   while (NULL != (ma = ma_head))
   {
     GNUNET_DHT_put_cancel (ma->ph);
@@ -667,15 +676,25 @@ handle_monitor_event (void *cls,
   struct GNUNET_GNSRECORD_Data rd_public[rd_count];
   unsigned int rd_public_count;
   struct MonitorActivity *ma;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pub;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received %u records for label `%s' via namestore monitor\n",
               rd_count,
               label);
+  /* local change, do not answer from stale cached records */
+  GNUNET_CRYPTO_ecdsa_key_get_public (zone, &pub);
+  GNS_resolver_invalidate (&pub, label);
   /* filter out records that are not public, and convert to
      absolute expiration time. */
   rd_public_count = convert_records_for_export (rd, rd_count,
                                                 rd_public);
+  if (GNUNET_YES == differential_publish)
+  {
+    GNS_publisher_update (zone, label,
+                          rd_public_count, rd_public);
+    return;
+  }
   if (0 == rd_public_count)
     return; /* nothing to do */
   ma = GNUNET_new (struct MonitorActivity);
@@ -856,6 +875,8 @@ notify_client_disconnect (void *cls,
 static void
 monitor_sync_event (void *cls)
 {
+  if (GNUNET_YES == differential_publish)
+    return; /* the publisher was fed by the monitor's initial iteration */
   zone_publish_task = GNUNET_SCHEDULER_add_now (&publish_zone_dht_start,
 						NULL);
 }
@@ -995,24 +1016,35 @@ run (void *cls,
                                        &identity_intercept_cb,
                                        (void *) c);
   }
+  statistics = GNUNET_STATISTICS_create ("gns", c);
   GNS_resolver_init (namecache_handle,
                      dht_handle,
 		     c,
+                     statistics,
 		     max_parallel_bg_queries);
   GNS_shorten_init (namestore_handle,
                     namecache_handle,
                     dht_handle);
+  differential_publish
+    = GNUNET_CONFIGURATION_get_value_yesno (c, "gns",
+                                            "ZONE_PUBLISH_DIFFERENTIAL");
+  if (GNUNET_SYSERR == differential_publish)
+    differential_publish = GNUNET_NO;
+  if (GNUNET_YES == differential_publish)
+    GNS_publisher_init (c,
+                        dht_handle,
+                        statistics,
+                        zone_publish_time_window_default);
   GNUNET_SERVER_disconnect_notify (server,
 				   &notify_client_disconnect,
 				   NULL);
   /* Schedule periodic put for our records. */
   first_zone_iteration = GNUNET_YES;
   GNUNET_SERVER_add_handlers (server, handlers);
-  statistics = GNUNET_STATISTICS_create ("gns", c);
   nc = GNUNET_SERVER_notification_context_create (server, 1);
   zmon = GNUNET_NAMESTORE_zone_monitor_start (c,
                                               NULL,
-                                              GNUNET_NO,
+                                              differential_publish,
                                               &handle_monitor_event,
                                               &monitor_sync_event,
                                               NULL);
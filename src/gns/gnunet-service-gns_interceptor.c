@@ -356,6 +356,11 @@ int
 GNS_interceptor_init (const struct GNUNET_CRYPTO_EcdsaPublicKey *gnu_zone,
 		      const struct GNUNET_CONFIGURATION_Handle *c)
 {
+  static const char *const tlds[] = {
+    GNUNET_GNS_TLD,
+    GNUNET_GNS_TLD_ZKEY
+  };
+
   GNUNET_log (GNUNET_ERROR_TYPE_INFO,
 	      "DNS hijacking enabled. Connecting to DNS service.\n");
   zone = *gnu_zone;
@@ -369,6 +374,13 @@ GNS_interceptor_init (const struct GNUNET_CRYPTO_EcdsaPublicKey *gnu_zone,
 		_("Failed to connect to the DNS service!\n"));
     return GNUNET_SYSERR;
   }
+  /* only look at our TLDs; our answers are signed and carry
+     proper TTLs, so the DNS service may reuse them */
+  GNUNET_DNS_add_filter (dns_handle,
+                         sizeof (tlds) / sizeof (tlds[0]), tlds,
+                         0, NULL,
+                         0, NULL,
+                         GNUNET_DNS_FILTER_FLAG_CACHE_ANSWERS);
   return GNUNET_YES;
 }
 
@@ -0,0 +1,646 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file gns/gnunet-service-gns_publisher.c
+ * @brief GNUnet GNS differential zone publisher
+ * @author Christian Grothoff
+ *
+ * Instead of walking the whole zone and PUTting every block on a
+ * fixed schedule, the publisher keeps the public records of all
+ * labels of our zones in a heap ordered by the time at which their
+ * block has to be PUT again: shortly before the block in the DHT
+ * expires (expiration minus the DHT republish frequency), but at
+ * least every @e max_interval.  Changes reported by the namestore
+ * monitor are due right away.  Due blocks are signed and PUT in
+ * batches, paced by a token bucket.
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_dht_service.h"
+#include "gnunet_gnsrecord_lib.h"
+#include "gnunet_statistics_service.h"
+#include "gnunet-service-gns_publisher.h"
+
+/**
+ * What replication level do we use for DHT PUT operations?
+ */
+#define DHT_GNS_REPLICATION_LEVEL 5
+
+/**
+ * How long until a DHT PUT attempt should time out?
+ */
+#define DHT_OPERATION_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 60)
+
+/**
+ * How many blocks do we PUT with one request at most?
+ */
+#define PUBLISH_BATCH_SIZE 32
+
+/**
+ * How many bytes of blocks do we PUT with one request at most?
+ * Must stay well below the maximum message size.
+ */
+#define PUBLISH_BATCH_BYTES (32 * 1024)
+
+/**
+ * Minimum time between two PUTs of the same block, so that records
+ * that (almost) expired do not make us spin.
+ */
+#define MIN_REPUBLISH_INTERVAL GNUNET_TIME_UNIT_MINUTES
+
+/**
+ * Default rate limit for zone publishing in bytes per second.
+ */
+#define DEFAULT_PUBLISH_BANDWIDTH (16 * 1024)
+
+/**
+ * For how many seconds may unused bandwidth accumulate?
+ */
+#define MAX_PUBLISH_CARRY_S 5
+
+
+/**
+ * A label of one of our zones that we publish.
+ */
+struct PublishRecord
+{
+
+  /**
+   * DHT key of the block, key in #records.
+   */
+  struct GNUNET_HashCode query;
+
+  /**
+   * Entry in #publish_heap, ordered by @e next_publish.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Private key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+
+  /**
+   * The label.
+   */
+  char *label;
+
+  /**
+   * Public records under @e label, allocated together with their data.
+   */
+  struct GNUNET_GNSRECORD_Data *rd;
+
+  /**
+   * Number of entries in @e rd.
+   */
+  unsigned int rd_count;
+
+  /**
+   * When do we have to PUT the block next?
+   */
+  struct GNUNET_TIME_Absolute next_publish;
+};
+
+
+/**
+ * Handle to the DHT.
+ */
+static struct GNUNET_DHT_Handle *dht_handle;
+
+/**
+ * Handle to the statistics service.
+ */
+static struct GNUNET_STATISTICS_Handle *statistics;
+
+/**
+ * Map from hash of a zone's private key to the
+ * `struct GNUNET_GNSRECORD_QueryContext` of the zone.  We only
+ * publish our own zones, so there are few of them and we keep the
+ * contexts until shutdown.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *query_contexts;
+
+/**
+ * Map from DHT key to `struct PublishRecord`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *records;
+
+/**
+ * Heap of `struct PublishRecord`, the next one due at the root.
+ */
+static struct GNUNET_CONTAINER_Heap *publish_heap;
+
+/**
+ * Token bucket pacing our PUTs.
+ */
+static struct GNUNET_BANDWIDTH_Tracker publish_tracker;
+
+/**
+ * #GNUNET_YES if #publish_tracker limits our PUTs.
+ */
+static int rate_limited;
+
+/**
+ * How many bytes can #publish_tracker hold at most?
+ */
+static size_t publish_burst;
+
+/**
+ * Active DHT PUT of a batch, NULL for none.
+ */
+static struct GNUNET_DHT_PutHandle *active_put;
+
+/**
+ * Task that PUTs the next batch.
+ */
+static struct GNUNET_SCHEDULER_Task *publish_task;
+
+/**
+ * Maximum time between two PUTs of the same block.
+ */
+static struct GNUNET_TIME_Relative publish_max_interval;
+
+
+/**
+ * Free a publish record, removing it from #records and
+ * #publish_heap.
+ *
+ * @param pr record to free
+ */
+static void
+free_publish_record (struct PublishRecord *pr)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (records,
+                                                       &pr->query,
+                                                       pr));
+  GNUNET_CONTAINER_heap_remove_node (pr->hn);
+  GNUNET_free_non_null (pr->rd);
+  GNUNET_free (pr->label);
+  GNUNET_free (pr);
+}
+
+
+/**
+ * Task that PUTs the blocks that are due.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+publish_due (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Calculate the DHT query for @a label in @a zone, with the query
+ * context of the zone.
+ *
+ * @param zone private key of the zone
+ * @param label the label
+ * @param query set to the DHT query
+ */
+static void
+get_query (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+           const char *label,
+           struct GNUNET_HashCode *query)
+{
+  struct GNUNET_GNSRECORD_QueryContext *qc;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pub;
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (zone, sizeof (*zone), &key);
+  qc = GNUNET_CONTAINER_multihashmap_get (query_contexts, &key);
+  if (NULL == qc)
+  {
+    GNUNET_CRYPTO_ecdsa_key_get_public (zone, &pub);
+    qc = GNUNET_GNSRECORD_query_context_create (&pub);
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (query_contexts,
+                                                      &key,
+                                                      qc,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  GNUNET_GNSRECORD_query_from_context (qc, label, query);
+}
+
+
+/**
+ * Free a query context.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct GNUNET_GNSRECORD_QueryContext`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_query_context_it (void *cls,
+                       const struct GNUNET_HashCode *key,
+                       void *value)
+{
+  GNUNET_GNSRECORD_query_context_destroy (value);
+  return GNUNET_OK;
+}
+
+
+/**
+ * (Re)schedule #publish_due for the record due next.
+ */
+static void
+schedule_publish ()
+{
+  struct PublishRecord *pr;
+
+  if (NULL != active_put)
+    return; /* #put_done will reschedule */
+  if (NULL != publish_task)
+  {
+    GNUNET_SCHEDULER_cancel (publish_task);
+    publish_task = NULL;
+  }
+  pr = GNUNET_CONTAINER_heap_peek (publish_heap);
+  if (NULL == pr)
+    return;
+  publish_task
+    = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (pr->next_publish),
+                                    &publish_due,
+                                    NULL);
+}
+
+
+/**
+ * Continuation called from the DHT once a batch was sent.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK on success
+ */
+static void
+put_done (void *cls,
+          int success)
+{
+  active_put = NULL;
+  if (GNUNET_OK != success)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to PUT zone blocks into the DHT\n"));
+  schedule_publish ();
+}
+
+
+/**
+ * Compute when a block that we PUT just now has to be PUT again.
+ *
+ * @param expire expiration time of the block
+ * @return time of the next PUT
+ */
+static struct GNUNET_TIME_Absolute
+get_next_publish (struct GNUNET_TIME_Absolute expire)
+{
+  struct GNUNET_TIME_Relative left;
+  struct GNUNET_TIME_Relative delay;
+
+  left = GNUNET_TIME_absolute_get_remaining (expire);
+  if (left.rel_value_us > 2 * GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY.rel_value_us)
+    delay = GNUNET_TIME_relative_subtract (left,
+                                           GNUNET_DHT_DEFAULT_REPUBLISH_FREQUENCY);
+  else
+    delay = GNUNET_TIME_relative_divide (left, 2);
+  delay = GNUNET_TIME_relative_min (delay,
+                                    publish_max_interval);
+  delay = GNUNET_TIME_relative_max (delay,
+                                    MIN_REPUBLISH_INTERVAL);
+  return GNUNET_TIME_relative_to_absolute (delay);
+}
+
+
+/**
+ * Sign the block for a publish record and add it to a batch.  Expired
+ * records are dropped first; if none are left, the record is freed.
+ *
+ * @param pr record to publish
+ * @param put where to store the DHT record
+ * @return #GNUNET_OK if @a put was filled in, #GNUNET_NO if there was
+ *         nothing to publish
+ */
+static int
+create_put (struct PublishRecord *pr,
+            struct GNUNET_DHT_PutRecord *put)
+{
+  struct GNUNET_GNSRECORD_Data rd[pr->rd_count];
+  struct GNUNET_GNSRECORD_Block *block;
+  struct GNUNET_TIME_Absolute now;
+  struct GNUNET_TIME_Absolute expire;
+  unsigned int rd_count;
+  unsigned int i;
+
+  now = GNUNET_TIME_absolute_get ();
+  rd_count = 0;
+  for (i=0;i<pr->rd_count;i++)
+  {
+    if ( (0 == (pr->rd[i].flags & GNUNET_GNSRECORD_RF_RELATIVE_EXPIRATION)) &&
+         (pr->rd[i].expiration_time < now.abs_value_us) )
+      continue;
+    rd[rd_count++] = pr->rd[i];
+  }
+  if (0 == rd_count)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "All records under label `%s' expired, no longer publishing it\n",
+                pr->label);
+    free_publish_record (pr);
+    return GNUNET_NO;
+  }
+  expire = GNUNET_GNSRECORD_record_get_expiration_time (rd_count,
+                                                        rd);
+  block = GNUNET_GNSRECORD_block_create (&pr->zone,
+                                         expire,
+                                         pr->label,
+                                         rd,
+                                         rd_count);
+  if (NULL == block)
+  {
+    GNUNET_break (0);
+    free_publish_record (pr);
+    return GNUNET_NO;
+  }
+  put->key = pr->query;
+  put->type = GNUNET_BLOCK_TYPE_GNS_NAMERECORD;
+  put->size = ntohl (block->purpose.size)
+    + sizeof (struct GNUNET_CRYPTO_EcdsaSignature)
+    + sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey);
+  put->data = block;
+  put->expiration = expire;
+  pr->next_publish = get_next_publish (expire);
+  GNUNET_CONTAINER_heap_update_cost (publish_heap,
+                                     pr->hn,
+                                     pr->next_publish.abs_value_us);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Publishing %u record(s) for label `%s' with expiration `%s', next PUT in %s\n",
+              rd_count,
+              pr->label,
+              GNUNET_STRINGS_absolute_time_to_string (expire),
+              GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_remaining (pr->next_publish),
+                                                      GNUNET_YES));
+  return GNUNET_OK;
+}
+
+
+/**
+ * Task that PUTs the blocks that are due.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+publish_due (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_DHT_PutRecord puts[PUBLISH_BATCH_SIZE];
+  struct PublishRecord *pr;
+  struct GNUNET_TIME_Relative delay;
+  unsigned int num_puts;
+  size_t batch_bytes;
+  size_t estimate;
+  unsigned int i;
+
+  publish_task = NULL;
+  num_puts = 0;
+  batch_bytes = 0;
+  delay = GNUNET_TIME_UNIT_ZERO;
+  while ( (num_puts < PUBLISH_BATCH_SIZE) &&
+          (NULL != (pr = GNUNET_CONTAINER_heap_peek (publish_heap))) &&
+          (0 == GNUNET_TIME_absolute_get_remaining (pr->next_publish).rel_value_us) )
+  {
+    /* upper bound for the size of the block, we only know it
+       exactly after signing */
+    estimate = sizeof (struct GNUNET_GNSRECORD_Block) + sizeof (uint32_t)
+      + GNUNET_GNSRECORD_records_get_size (pr->rd_count,
+                                           pr->rd);
+    if ( (0 != num_puts) &&
+         (batch_bytes + estimate > PUBLISH_BATCH_BYTES) )
+      break;
+    if (GNUNET_YES == rate_limited)
+    {
+      /* blocks larger than what the bucket can hold put it into debt */
+      delay = GNUNET_BANDWIDTH_tracker_get_delay (&publish_tracker,
+                                                  GNUNET_MIN (estimate,
+                                                              publish_burst));
+      if (0 != delay.rel_value_us)
+        break;
+    }
+    if (GNUNET_OK != create_put (pr,
+                                 &puts[num_puts]))
+      continue;
+    if (GNUNET_YES == rate_limited)
+      GNUNET_BANDWIDTH_tracker_consume (&publish_tracker,
+                                        puts[num_puts].size);
+    batch_bytes += puts[num_puts].size;
+    num_puts++;
+  }
+  if (0 == num_puts)
+  {
+    if (0 != delay.rel_value_us)
+      publish_task = GNUNET_SCHEDULER_add_delayed (delay,
+                                                   &publish_due,
+                                                   NULL);
+    else
+      schedule_publish ();
+    return;
+  }
+  active_put = GNUNET_DHT_put_batch (dht_handle,
+                                     num_puts,
+                                     puts,
+                                     DHT_GNS_REPLICATION_LEVEL,
+                                     GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
+                                     DHT_OPERATION_TIMEOUT,
+                                     &put_done,
+                                     NULL);
+  GNUNET_STATISTICS_update (statistics,
+                            "Number of zone blocks published",
+                            num_puts,
+                            GNUNET_NO);
+  for (i=0;i<num_puts;i++)
+    GNUNET_free ((void *) puts[i].data);
+  if (NULL == active_put)
+  {
+    GNUNET_break (0);
+    schedule_publish ();
+  }
+}
+
+
+/**
+ * The public records under a label of one of our zones changed (or
+ * were seen for the first time); publish them as soon as the rate
+ * limit allows and from then on whenever the block is about to
+ * expire.
+ *
+ * @param zone private key of the zone
+ * @param label the label
+ * @param rd_public_count number of records in @a rd_public,
+ *        0 to stop publishing the label
+ * @param rd_public public records under @a label
+ */
+void
+GNS_publisher_update (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                      const char *label,
+                      unsigned int rd_public_count,
+                      const struct GNUNET_GNSRECORD_Data *rd_public)
+{
+  struct GNUNET_HashCode query;
+  struct PublishRecord *pr;
+  unsigned int i;
+  size_t req;
+  char *data;
+
+  if (NULL == records)
+    return;
+  get_query (zone,
+             label,
+             &query);
+  pr = GNUNET_CONTAINER_multihashmap_get (records,
+                                          &query);
+  if (0 == rd_public_count)
+  {
+    if (NULL != pr)
+      free_publish_record (pr);
+    schedule_publish ();
+    return;
+  }
+  if (NULL == pr)
+  {
+    pr = GNUNET_new (struct PublishRecord);
+    pr->query = query;
+    pr->zone = *zone;
+    pr->label = GNUNET_strdup (label);
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (records,
+                                                      &pr->query,
+                                                      pr,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    pr->hn = GNUNET_CONTAINER_heap_insert (publish_heap,
+                                           pr,
+                                           0);
+  }
+  GNUNET_free_non_null (pr->rd);
+  req = sizeof (struct GNUNET_GNSRECORD_Data) * rd_public_count;
+  for (i=0;i<rd_public_count;i++)
+    req += rd_public[i].data_size;
+  pr->rd = GNUNET_malloc (req);
+  pr->rd_count = rd_public_count;
+  data = (char *) &pr->rd[rd_public_count];
+  for (i=0;i<rd_public_count;i++)
+  {
+    pr->rd[i] = rd_public[i];
+    pr->rd[i].data = data;
+    memcpy (data, rd_public[i].data, rd_public[i].data_size);
+    data += rd_public[i].data_size;
+  }
+  /* changed records are due right away */
+  pr->next_publish = GNUNET_TIME_UNIT_ZERO_ABS;
+  GNUNET_CONTAINER_heap_update_cost (publish_heap,
+                                     pr->hn,
+                                     0);
+  GNUNET_STATISTICS_set (statistics,
+                         "Number of labels published",
+                         GNUNET_CONTAINER_multihashmap_size (records),
+                         GNUNET_NO);
+  schedule_publish ();
+}
+
+
+/**
+ * Initialize the differential zone publisher.
+ *
+ * @param c configuration to use
+ * @param dht handle to the DHT
+ * @param stats handle to the statistics service
+ * @param max_interval maximum time between two PUTs of the same block,
+ *        even if it expires much later (to survive churn in the DHT)
+ */
+void
+GNS_publisher_init (const struct GNUNET_CONFIGURATION_Handle *c,
+                    struct GNUNET_DHT_Handle *dht,
+                    struct GNUNET_STATISTICS_Handle *stats,
+                    struct GNUNET_TIME_Relative max_interval)
+{
+  unsigned long long bandwidth;
+
+  dht_handle = dht;
+  statistics = stats;
+  publish_max_interval = GNUNET_TIME_relative_max (max_interval,
+                                                   MIN_REPUBLISH_INTERVAL);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_size (c, "gns",
+                                           "ZONE_PUBLISH_BANDWIDTH",
+                                           &bandwidth))
+    bandwidth = DEFAULT_PUBLISH_BANDWIDTH;
+  if (bandwidth > UINT32_MAX)
+    bandwidth = UINT32_MAX;
+  rate_limited = (0 != bandwidth) ? GNUNET_YES : GNUNET_NO;
+  publish_burst = bandwidth * MAX_PUBLISH_CARRY_S;
+  if (GNUNET_YES == rate_limited)
+    GNUNET_BANDWIDTH_tracker_init (&publish_tracker,
+                                   NULL, NULL,
+                                   GNUNET_BANDWIDTH_value_init ((uint32_t) bandwidth),
+                                   MAX_PUBLISH_CARRY_S);
+  records = GNUNET_CONTAINER_multihashmap_create (1024,
+                                                  GNUNET_NO);
+  query_contexts = GNUNET_CONTAINER_multihashmap_create (4,
+                                                         GNUNET_NO);
+  publish_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+}
+
+
+/**
+ * Stop publishing and free all state of the publisher.
+ */
+void
+GNS_publisher_done ()
+{
+  struct PublishRecord *pr;
+
+  if (NULL != publish_task)
+  {
+    GNUNET_SCHEDULER_cancel (publish_task);
+    publish_task = NULL;
+  }
+  if (NULL != active_put)
+  {
+    GNUNET_DHT_put_cancel (active_put);
+    active_put = NULL;
+  }
+  if (NULL == records)
+    return;
+  while (NULL != (pr = GNUNET_CONTAINER_heap_peek (publish_heap)))
+    free_publish_record (pr);
+  GNUNET_CONTAINER_heap_destroy (publish_heap);
+  publish_heap = NULL;
+  GNUNET_CONTAINER_multihashmap_destroy (records);
+  records = NULL;
+  GNUNET_CONTAINER_multihashmap_iterate (query_contexts,
+                                         &free_query_context_it,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (query_contexts);
+  query_contexts = NULL;
+  dht_handle = NULL;
+  statistics = NULL;
+}
+
+/* end of gnunet-service-gns_publisher.c */
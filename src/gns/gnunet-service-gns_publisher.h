@@ -0,0 +1,75 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file gns/gnunet-service-gns_publisher.h
+ * @brief GNUnet GNS differential zone publisher
+ * @author Christian Grothoff
+ */
+#ifndef GNS_PUBLISHER_H
+#define GNS_PUBLISHER_H
+#include "gns.h"
+#include "gnunet_dht_service.h"
+#include "gnunet_gnsrecord_lib.h"
+#include "gnunet_statistics_service.h"
+
+
+/**
+ * Initialize the differential zone publisher.
+ *
+ * @param c configuration to use
+ * @param dht handle to the DHT
+ * @param stats handle to the statistics service
+ * @param max_interval maximum time between two PUTs of the same block,
+ *        even if it expires much later (to survive churn in the DHT)
+ */
+void
+GNS_publisher_init (const struct GNUNET_CONFIGURATION_Handle *c,
+                    struct GNUNET_DHT_Handle *dht,
+                    struct GNUNET_STATISTICS_Handle *stats,
+                    struct GNUNET_TIME_Relative max_interval);
+
+
+/**
+ * Stop publishing and free all state of the publisher.
+ */
+void
+GNS_publisher_done (void);
+
+
+/**
+ * The public records under a label of one of our zones changed (or
+ * were seen for the first time); publish them as soon as the rate
+ * limit allows and from then on whenever the block is about to
+ * expire.
+ *
+ * @param zone private key of the zone
+ * @param label the label
+ * @param rd_public_count number of records in @a rd_public,
+ *        0 to stop publishing the label
+ * @param rd_public public records under @a label
+ */
+void
+GNS_publisher_update (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                      const char *label,
+                      unsigned int rd_public_count,
+                      const struct GNUNET_GNSRECORD_Data *rd_public);
+
+
+#endif
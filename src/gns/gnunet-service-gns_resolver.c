@@ -31,6 +31,7 @@
 #include "gnunet_gnsrecord_lib.h"
 #include "gnunet_namecache_service.h"
 #include "gnunet_namestore_service.h"
+#include "gnunet_statistics_service.h"
 #include "gnunet_dns_service.h"
 #include "gnunet_resolver_service.h"
 #include "gnunet_revocation_service.h"
@@ -68,6 +69,45 @@
  */
 #define MAX_RECURSION 256
 
+/**
+ * Default number of decrypted record sets we keep in the record cache.
+ */
+#define DEFAULT_RECORD_CACHE_SIZE 1024
+
+/**
+ * Default time for which we remember that a label has no records.
+ */
+#define DEFAULT_NEGATIVE_CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 30)
+
+/**
+ * How long must a DHT lookup have been running without result
+ * before we consider the label to be absent when it is cancelled?
+ */
+#define NEGATIVE_DHT_MIN_AGE GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * Refresh a cached record set from the DHT when it is used after
+ * less than 1/REFRESH_AHEAD_FACTOR of its lifetime remains.
+ */
+#define REFRESH_AHEAD_FACTOR 5
+
+/**
+ * Maximum number of cache refreshes we run in parallel.
+ */
+#define MAX_REFRESHES 32
+
+/**
+ * For how many zones do we keep a query context?  Each context holds
+ * a precomputed table of a few hundred KiB.
+ */
+#define MAX_QUERY_CONTEXTS 16
+
+/**
+ * Size of the stack arena we parse DNS responses into; larger
+ * responses spill over to the heap.
+ */
+#define DNS_PARSE_ARENA_SIZE (8 * 1024)
+
 
 /**
  * DLL to hold the authority chain we had to pass in the resolution
@@ -310,6 +350,28 @@ struct GNS_ResolverHandle
    */
   struct GNUNET_REVOCATION_Query *rev_check;
 
+  /**
+   * Serialized records for the tail of the authority chain that
+   * arrived while the revocation check was still pending.
+   */
+  char *deferred_rd_data;
+
+  /**
+   * Number of bytes in @e deferred_rd_data.
+   */
+  size_t deferred_rd_size;
+
+  /**
+   * Number of records in @e deferred_rd_data.
+   */
+  unsigned int deferred_rd_count;
+
+  /**
+   * #GNUNET_YES if records were deferred until the revocation
+   * check completes.
+   */
+  int records_deferred;
+
   /**
    * Heap node associated with this lookup.  Used to limit number of
    * concurrent requests.
@@ -385,6 +447,57 @@ struct GNS_ResolverHandle
    */
   unsigned int loop_limiter;
 
+  /**
+   * For lookups attached to an identical lookup that is already
+   * running: the lookup doing the actual work.  NULL otherwise.
+   */
+  struct GNS_ResolverHandle *leader;
+
+  /**
+   * Head of lookups attached to this one (if we are a leader).
+   */
+  struct GNS_ResolverHandle *follower_head;
+
+  /**
+   * Tail of lookups attached to this one (if we are a leader).
+   */
+  struct GNS_ResolverHandle *follower_tail;
+
+  /**
+   * Kept in a DLL of followers of the @e leader.
+   */
+  struct GNS_ResolverHandle *next_follower;
+
+  /**
+   * Kept in a DLL of followers of the @e leader.
+   */
+  struct GNS_ResolverHandle *prev_follower;
+
+  /**
+   * Result processor of the client of a leader; the leader's
+   * @e proc fans the result out to all followers and this one.
+   * NULL if the client of the leader cancelled the lookup while
+   * followers still wait for the result.
+   */
+  GNS_ResultProcessor client_proc;
+
+  /**
+   * Closure for @e client_proc.
+   */
+  void *client_proc_cls;
+
+  /**
+   * Hash over zone, name, record type, options and shortening key,
+   * key of the lookup in #active_lookups.
+   */
+  struct GNUNET_HashCode lookup_key;
+
+  /**
+   * #GNUNET_YES if this lookup is in #active_lookups and new
+   * identical lookups may attach to it.
+   */
+  int in_active_lookups;
+
 };
 
 
@@ -412,11 +525,203 @@ struct CacheOps
 };
 
 
+/**
+ * Entry in the record cache: a decrypted and verified record set
+ * for a (zone, label) pair, or the knowledge that there is none.
+ * The serialized records follow the struct.
+ */
+struct RecordCacheEntry
+{
+
+  /**
+   * Hash of zone and label, key in #record_cache.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Node of this entry in #record_cache_lru.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * When does the entry expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * When was the entry created?
+   */
+  struct GNUNET_TIME_Absolute created;
+
+  /**
+   * Number of bytes of serialized records following the struct.
+   */
+  size_t data_size;
+
+  /**
+   * Number of records in the record set.
+   */
+  unsigned int rd_count;
+
+  /**
+   * #GNUNET_YES if no block exists for the label (negative entry).
+   */
+  int negative;
+
+  /**
+   * For negative entries: #GNUNET_YES if the DHT was asked as well,
+   * #GNUNET_NO if only the namecache was checked.
+   */
+  int dht_checked;
+
+  /**
+   * #GNUNET_YES if we already tried to refresh the entry ahead
+   * of its expiration.
+   */
+  int refresh_tried;
+
+};
+
+
+/**
+ * Zone we computed DHT queries for recently.
+ */
+struct ZoneQueryContext
+{
+
+  /**
+   * Public key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey zone;
+
+  /**
+   * Hash of @e zone, key in #query_contexts.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Entry in #query_context_lru.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Query context of the zone; only created once the zone is used a
+   * second time, as creating it costs about five queries.
+   */
+  struct GNUNET_GNSRECORD_QueryContext *qc;
+
+};
+
+
+/**
+ * Background DHT lookup refreshing a record set in the record cache
+ * before it expires.
+ */
+struct CacheRefresh
+{
+
+  /**
+   * Key of the record set in the record cache, and in #refreshes.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Zone of the record set.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey zone;
+
+  /**
+   * Label of the record set.
+   */
+  char *label;
+
+  /**
+   * Expiration time of the cached record set we want to replace.
+   */
+  struct GNUNET_TIME_Absolute old_expiration;
+
+  /**
+   * Expiration time of the block being decrypted.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * DHT lookup for a newer block.
+   */
+  struct GNUNET_DHT_GetHandle *get_handle;
+
+  /**
+   * Task ending the refresh if the DHT has no newer block.
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+};
+
+
 /**
  * Our handle to the namecache service
  */
 static struct GNUNET_NAMECACHE_Handle *namecache_handle;
 
+/**
+ * Handle to the statistics service.
+ */
+static struct GNUNET_STATISTICS_Handle *statistics;
+
+/**
+ * Map of hashes of (zone, label) to `struct RecordCacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *record_cache;
+
+/**
+ * Heap of `struct RecordCacheEntry`s by time of last use, for LRU
+ * eviction.
+ */
+static struct GNUNET_CONTAINER_Heap *record_cache_lru;
+
+/**
+ * Maximum number of entries in the #record_cache, 0 if disabled.
+ */
+static unsigned long long record_cache_size;
+
+/**
+ * For how long do we cache negative results?
+ */
+static struct GNUNET_TIME_Relative negative_cache_ttl;
+
+/**
+ * Map of hashes of zone keys to `struct ZoneQueryContext`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *query_contexts;
+
+/**
+ * Heap of `struct ZoneQueryContext`s by time of last use, for LRU
+ * eviction.
+ */
+static struct GNUNET_CONTAINER_Heap *query_context_lru;
+
+/**
+ * Map of hashes of (zone, label) to active `struct CacheRefresh`es.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *refreshes;
+
+/**
+ * Map of lookup keys to the `struct GNS_ResolverHandle` of running
+ * lookups that identical lookups can share.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *active_lookups;
+
+/**
+ * Do we look up labels in delegated zones in the namecache and the
+ * DHT in parallel?
+ */
+static int prefetch_delegations;
+
+/**
+ * Do we refresh cached record sets before they expire?
+ */
+static int refresh_ahead;
+
 /**
  * Our handle to the vpn service
  */
@@ -537,6 +842,227 @@ translate_dot_plus (struct GNS_ResolverHandle *rh,
 }
 
 
+/**
+ * Compute the key of the record set for @a label in @a zone in
+ * the #record_cache.
+ *
+ * @param zone the zone
+ * @param label the label
+ * @param key set to the key
+ */
+static void
+get_record_cache_key (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                      const char *label,
+                      struct GNUNET_HashCode *key)
+{
+  size_t llen = strlen (label);
+  char buf[sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey) + llen];
+
+  memcpy (buf, zone, sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey));
+  memcpy (&buf[sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey)], label, llen);
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), key);
+}
+
+
+/**
+ * Free a zone query context, removing it from #query_contexts and
+ * #query_context_lru.
+ *
+ * @param zqc context to free
+ */
+static void
+free_zone_query_context (struct ZoneQueryContext *zqc)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (query_contexts,
+                                                       &zqc->key,
+                                                       zqc));
+  GNUNET_CONTAINER_heap_remove_node (zqc->hn);
+  if (NULL != zqc->qc)
+    GNUNET_GNSRECORD_query_context_destroy (zqc->qc);
+  GNUNET_free (zqc);
+}
+
+
+/**
+ * Calculate the DHT query for @a label in @a zone, using a query
+ * context with a precomputed table for zones we look up labels in
+ * repeatedly.
+ *
+ * @param zone the zone
+ * @param label the label
+ * @param query set to the DHT query
+ */
+static void
+get_query (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+           const char *label,
+           struct GNUNET_HashCode *query)
+{
+  struct ZoneQueryContext *zqc;
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (zone, sizeof (*zone), &key);
+  zqc = GNUNET_CONTAINER_multihashmap_get (query_contexts, &key);
+  if (NULL == zqc)
+  {
+    if (GNUNET_CONTAINER_multihashmap_size (query_contexts) >= MAX_QUERY_CONTEXTS)
+      free_zone_query_context (GNUNET_CONTAINER_heap_peek (query_context_lru));
+    zqc = GNUNET_new (struct ZoneQueryContext);
+    zqc->zone = *zone;
+    zqc->key = key;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (query_contexts,
+                                                      &zqc->key,
+                                                      zqc,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    zqc->hn = GNUNET_CONTAINER_heap_insert (query_context_lru,
+                                            zqc,
+                                            GNUNET_TIME_absolute_get ().abs_value_us);
+    GNUNET_GNSRECORD_query_from_public_key (zone, label, query);
+    return;
+  }
+  GNUNET_CONTAINER_heap_update_cost (query_context_lru,
+                                     zqc->hn,
+                                     GNUNET_TIME_absolute_get ().abs_value_us);
+  if (NULL == zqc->qc)
+    zqc->qc = GNUNET_GNSRECORD_query_context_create (zone);
+  GNUNET_GNSRECORD_query_from_context (zqc->qc, label, query);
+}
+
+
+/**
+ * Remove an entry from the record cache and free it.
+ *
+ * @param rce entry to remove
+ */
+static void
+free_record_cache_entry (struct RecordCacheEntry *rce)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (record_cache,
+                                                       &rce->key,
+                                                       rce));
+  GNUNET_CONTAINER_heap_remove_node (rce->hn);
+  GNUNET_free (rce);
+}
+
+
+/**
+ * Add an entry for @a label in @a zone to the record cache,
+ * replacing any existing entry and evicting the least recently
+ * used entry if the cache is full.
+ *
+ * @param zone the zone
+ * @param label the label
+ * @param expiration when does the entry expire
+ * @param negative #GNUNET_YES if there is no block for the label
+ * @param dht_checked #GNUNET_YES if the DHT was consulted (negative entries)
+ * @param rd_count number of records in @a rd
+ * @param rd the records
+ */
+static void
+cache_records (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+               const char *label,
+               struct GNUNET_TIME_Absolute expiration,
+               int negative,
+               int dht_checked,
+               unsigned int rd_count,
+               const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct RecordCacheEntry *rce;
+  struct GNUNET_HashCode key;
+  ssize_t data_size;
+
+  if ( (0 == record_cache_size) ||
+       (0 == GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us) )
+    return;
+  data_size = GNUNET_GNSRECORD_records_get_size (rd_count, rd);
+  if (data_size < 0)
+  {
+    GNUNET_break (0);
+    return;
+  }
+  get_record_cache_key (zone, label, &key);
+  rce = GNUNET_CONTAINER_multihashmap_get (record_cache, &key);
+  if (NULL != rce)
+    free_record_cache_entry (rce);
+  rce = GNUNET_malloc (sizeof (struct RecordCacheEntry) + data_size);
+  if (data_size !=
+      GNUNET_GNSRECORD_records_serialize (rd_count, rd,
+                                          data_size,
+                                          (char *) &rce[1]))
+  {
+    GNUNET_break (0);
+    GNUNET_free (rce);
+    return;
+  }
+  rce->key = key;
+  rce->expiration = expiration;
+  rce->created = GNUNET_TIME_absolute_get ();
+  rce->data_size = data_size;
+  rce->rd_count = rd_count;
+  rce->negative = negative;
+  rce->dht_checked = dht_checked;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (record_cache,
+                                                    &rce->key,
+                                                    rce,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  rce->hn = GNUNET_CONTAINER_heap_insert (record_cache_lru,
+                                          rce,
+                                          GNUNET_TIME_absolute_get ().abs_value_us);
+  while (GNUNET_CONTAINER_multihashmap_size (record_cache) > record_cache_size)
+    free_record_cache_entry (GNUNET_CONTAINER_heap_peek (record_cache_lru));
+  GNUNET_STATISTICS_set (statistics,
+                         gettext_noop ("# GNS record cache entries"),
+                         GNUNET_CONTAINER_multihashmap_size (record_cache),
+                         GNUNET_NO);
+}
+
+
+/**
+ * Remember that the label at the tail of the authority chain of
+ * @a rh has no records.
+ *
+ * @param rh resolution that failed to find a block
+ * @param dht_checked #GNUNET_YES if the DHT was consulted
+ */
+static void
+cache_negative (struct GNS_ResolverHandle *rh,
+                int dht_checked)
+{
+  struct AuthorityChain *ac = rh->ac_tail;
+
+  if ( (NULL == ac) ||
+       (GNUNET_YES != ac->gns_authority) )
+    return;
+  cache_records (&ac->authority_info.gns_authority,
+                 ac->label,
+                 GNUNET_TIME_relative_to_absolute (negative_cache_ttl),
+                 GNUNET_YES,
+                 dht_checked,
+                 0, NULL);
+}
+
+
+/**
+ * Function called to free an entry of the record cache.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct RecordCacheEntry` to free
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_record_cache_entry_it (void *cls,
+                            const struct GNUNET_HashCode *key,
+                            void *value)
+{
+  free_record_cache_entry (value);
+  return GNUNET_OK;
+}
+
+
 /**
  * Task scheduled to asynchronously fail a resolution.
  *
@@ -840,18 +1366,25 @@ dns_result_parser (void *cls,
   struct GNS_ResolverHandle *rh = cls;
   struct GNUNET_DNSPARSER_Packet *p;
   const struct GNUNET_DNSPARSER_Record *rec;
+  struct GNUNET_DNSPARSER_Arena arena;
+  char arena_mem[DNS_PARSE_ARENA_SIZE];
   unsigned int rd_count;
   unsigned int i;
 
   rh->dns_request = NULL;
   GNUNET_SCHEDULER_cancel (rh->task_id);
   rh->task_id = NULL;
-  p = GNUNET_DNSPARSER_parse ((const char *) dns,
-			      dns_len);
+  GNUNET_DNSPARSER_arena_init (&arena,
+                               arena_mem,
+                               sizeof (arena_mem));
+  p = GNUNET_DNSPARSER_parse_arena (&arena,
+                                    (const char *) dns,
+                                    dns_len);
   if (NULL == p)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
 		_("Failed to parse DNS response\n"));
+    GNUNET_DNSPARSER_arena_release (&arena);
     rh->proc (rh->proc_cls, 0, NULL);
     GNS_resolver_lookup_cancel (rh);
     return;
@@ -867,8 +1400,8 @@ dns_result_parser (void *cls,
       GNUNET_free (rh->name);
       rh->name = GNUNET_strdup (p->answers[0].data.hostname);
       rh->name_resolution_pos = strlen (rh->name);
+      GNUNET_DNSPARSER_arena_release (&arena);
       start_resolver_lookup (rh);
-      GNUNET_DNSPARSER_free_packet (p);
       return;
     }
 
@@ -1006,7 +1539,7 @@ dns_result_parser (void *cls,
     rh->proc (rh->proc_cls, rd_count - skip, rd);
     GNS_resolver_lookup_cancel (rh);
   }
-  GNUNET_DNSPARSER_free_packet (p);
+  GNUNET_DNSPARSER_arena_release (&arena);
 }
 
 
@@ -1023,9 +1556,9 @@ recursive_dns_resolution (struct GNS_ResolverHandle *rh)
 {
   struct AuthorityChain *ac;
   socklen_t sa_len;
-  struct GNUNET_DNSPARSER_Query *query;
-  struct GNUNET_DNSPARSER_Packet *p;
-  char *dns_request;
+  struct GNUNET_DNSPARSER_Query query;
+  struct GNUNET_DNSPARSER_Packet p;
+  char dns_request[1024];
   size_t dns_request_length;
 
   ac = rh->ac_tail;
@@ -1048,19 +1581,22 @@ recursive_dns_resolution (struct GNS_ResolverHandle *rh)
     GNS_resolver_lookup_cancel (rh);
     return;
   }
-  query = GNUNET_new (struct GNUNET_DNSPARSER_Query);
-  query->name = GNUNET_strdup (ac->label);
-  query->type = rh->record_type;
-  query->dns_traffic_class = GNUNET_TUN_DNS_CLASS_INTERNET;
-  p = GNUNET_new (struct GNUNET_DNSPARSER_Packet);
-  p->queries = query;
-  p->num_queries = 1;
-  p->id = (uint16_t) GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
-					       UINT16_MAX);
-  p->flags.opcode = GNUNET_TUN_DNS_OPCODE_QUERY;
-  p->flags.recursion_desired = 1;
+  memset (&query, 0, sizeof (query));
+  query.name = ac->label;
+  query.type = rh->record_type;
+  query.dns_traffic_class = GNUNET_TUN_DNS_CLASS_INTERNET;
+  memset (&p, 0, sizeof (p));
+  p.queries = &query;
+  p.num_queries = 1;
+  p.id = (uint16_t) GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
+					      UINT16_MAX);
+  p.flags.opcode = GNUNET_TUN_DNS_OPCODE_QUERY;
+  p.flags.recursion_desired = 1;
   if (GNUNET_OK !=
-      GNUNET_DNSPARSER_pack (p, 1024, &dns_request, &dns_request_length))
+      GNUNET_DNSPARSER_pack_to_buffer (&p,
+                                       dns_request,
+                                       sizeof (dns_request),
+                                       &dns_request_length))
   {
     GNUNET_break (0);
     rh->proc (rh->proc_cls, 0, NULL);
@@ -1079,8 +1615,6 @@ recursive_dns_resolution (struct GNS_ResolverHandle *rh)
 						&fail_resolution,
 						rh);
   }
-  GNUNET_free (dns_request);
-  GNUNET_DNSPARSER_free_packet (p);
 }
 
 
@@ -1895,7 +2429,135 @@ handle_gns_resolution_result (void *cls,
 
 
 /**
- * Function called once the namestore has completed the request for
+ * Add a record set decrypted from a block to the record cache.
+ *
+ * @param zone zone of the block
+ * @param label label of the block
+ * @param block_expiration expiration time of the block
+ * @param rd_count number of entries in @a rd array
+ * @param rd array of records
+ */
+static void
+cache_decrypted_records (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                         const char *label,
+                         struct GNUNET_TIME_Absolute block_expiration,
+                         unsigned int rd_count,
+                         const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct GNUNET_TIME_Absolute expiration;
+  unsigned int i;
+
+  /* the decrypted set changes as soon as any of its records
+     expires (shadow records may become visible) */
+  expiration = block_expiration;
+  for (i = 0; i < rd_count; i++)
+    expiration = GNUNET_TIME_absolute_min (expiration,
+                                           GNUNET_GNSRECORD_record_get_expiration_time (1, &rd[i]));
+  cache_records (zone,
+                 label,
+                 expiration,
+                 GNUNET_NO,
+                 GNUNET_NO,
+                 rd_count,
+                 rd);
+}
+
+
+/**
+ * Continue the resolution with the records found for the tail of
+ * the authority chain.  As the revocation check of the zone runs in
+ * parallel with the lookup, the records are kept until the check
+ * confirms that the zone was not revoked.
+ *
+ * @param rh resolution to continue
+ * @param rd_count number of entries in @a rd array
+ * @param rd array of records
+ */
+static void
+continue_with_records (struct GNS_ResolverHandle *rh,
+                       unsigned int rd_count,
+                       const struct GNUNET_GNSRECORD_Data *rd)
+{
+  ssize_t size;
+
+  if (NULL == rh->rev_check)
+  {
+    handle_gns_resolution_result (rh,
+                                  rd_count,
+                                  rd);
+    return;
+  }
+  size = GNUNET_GNSRECORD_records_get_size (rd_count, rd);
+  if (size < 0)
+  {
+    GNUNET_break (0);
+    rh->proc (rh->proc_cls, 0, NULL);
+    GNS_resolver_lookup_cancel (rh);
+    return;
+  }
+  GNUNET_assert (GNUNET_NO == rh->records_deferred);
+  rh->deferred_rd_data = (0 == size) ? NULL : GNUNET_malloc (size);
+  GNUNET_assert (size ==
+                 GNUNET_GNSRECORD_records_serialize (rd_count, rd,
+                                                     size,
+                                                     rh->deferred_rd_data));
+  rh->deferred_rd_size = size;
+  rh->deferred_rd_count = rd_count;
+  rh->records_deferred = GNUNET_YES;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Records for `%s' arrived before revocation check completed\n",
+              rh->ac_tail->label);
+}
+
+
+/**
+ * Closure for #handle_decrypted_records().
+ */
+struct DecryptContext
+{
+  /**
+   * Resolution the block was decrypted for.
+   */
+  struct GNS_ResolverHandle *rh;
+
+  /**
+   * Expiration time of the block.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+};
+
+
+/**
+ * Process the records decrypted from a block (from the namecache or
+ * the DHT): add them to the record cache and continue the resolution
+ * with #handle_gns_resolution_result().
+ *
+ * @param cls closure with the `struct DecryptContext`
+ * @param rd_count number of entries in @a rd array
+ * @param rd array of records
+ */
+static void
+handle_decrypted_records (void *cls,
+                          unsigned int rd_count,
+                          const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct DecryptContext *dc = cls;
+  struct GNS_ResolverHandle *rh = dc->rh;
+  struct AuthorityChain *ac = rh->ac_tail;
+
+  cache_decrypted_records (&ac->authority_info.gns_authority,
+                           ac->label,
+                           dc->expiration,
+                           rd_count,
+                           rd);
+  continue_with_records (rh,
+                         rd_count,
+                         rd);
+}
+
+
+/**
+ * Function called once the namestore has completed the request for
  * caching a block.
  *
  * @param cls closure with the `struct CacheOps`
@@ -1952,12 +2614,20 @@ handle_dht_response (void *cls,
   struct GNS_ResolverHandle *rh = cls;
   struct AuthorityChain *ac = rh->ac_tail;
   const struct GNUNET_GNSRECORD_Block *block;
+  struct DecryptContext dc;
+  struct GNUNET_TIME_Absolute expiration;
   struct CacheOps *co;
 
   GNUNET_DHT_get_stop (rh->get_handle);
   rh->get_handle = NULL;
   GNUNET_CONTAINER_heap_remove_node (rh->dht_heap_node);
   rh->dht_heap_node = NULL;
+  if (NULL != rh->namecache_qe)
+  {
+    /* DHT answered the speculative lookup before the namecache */
+    GNUNET_NAMECACHE_cancel (rh->namecache_qe);
+    rh->namecache_qe = NULL;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Handling response from the DHT\n");
   if (size < sizeof (struct GNUNET_GNSRECORD_Block))
@@ -1980,19 +2650,22 @@ handle_dht_response (void *cls,
     GNS_resolver_lookup_cancel (rh);
     return;
   }
+  expiration = GNUNET_TIME_absolute_ntoh (block->expiration_time);
+  dc.rh = rh;
+  dc.expiration = expiration;
   if (GNUNET_OK !=
       GNUNET_GNSRECORD_block_decrypt (block,
 				      &ac->authority_info.gns_authority,
 				      ac->label,
-				      &handle_gns_resolution_result,
-				      rh))
+				      &handle_decrypted_records,
+				      &dc))
   {
     GNUNET_break_op (0); /* block was ill-formed */
     rh->proc (rh->proc_cls, 0, NULL);
     GNS_resolver_lookup_cancel (rh);
     return;
   }
-  if (0 == GNUNET_TIME_absolute_get_remaining (GNUNET_TIME_absolute_ntoh (block->expiration_time)).rel_value_us)
+  if (0 == GNUNET_TIME_absolute_get_remaining (expiration).rel_value_us)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Received expired block from the DHT, will not cache it.\n");
@@ -2024,12 +2697,14 @@ start_dht_request (struct GNS_ResolverHandle *rh,
 {
   struct GNS_ResolverHandle *rx;
 
-  GNUNET_assert (NULL == rh->get_handle);
+  if (NULL != rh->get_handle)
+    return; /* speculative lookup already running */
   rh->get_handle = GNUNET_DHT_get_start (dht_handle,
                                          GNUNET_BLOCK_TYPE_GNS_NAMERECORD,
                                          query,
                                          DHT_GNS_REPLICATION_LEVEL,
-                                         GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
+                                         GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE |
+                                         GNUNET_DHT_RO_PARALLEL_LOOKUP,
                                          NULL, 0,
                                          &handle_dht_response, rh);
   rh->dht_heap_node = GNUNET_CONTAINER_heap_insert (dht_lookup_heap,
@@ -2050,7 +2725,7 @@ start_dht_request (struct GNS_ResolverHandle *rh,
  * Process a records that were decrypted from a block that we got from
  * the namecache.  Simply calls #handle_gns_resolution_result().
  *
- * @param cls closure with the `struct GNS_ResolverHandle`
+ * @param cls closure with the `struct DecryptContext`
  * @param rd_count number of entries in @a rd array
  * @param rd array of records with data to store
  */
@@ -2059,11 +2734,9 @@ handle_gns_namecache_resolution_result (void *cls,
                                         unsigned int rd_count,
                                         const struct GNUNET_GNSRECORD_Data *rd)
 {
-  struct GNS_ResolverHandle *rh = cls;
-
-  handle_gns_resolution_result (rh,
-                                rd_count,
-                                rd);
+  handle_decrypted_records (cls,
+                            rd_count,
+                            rd);
 }
 
 
@@ -2082,6 +2755,7 @@ handle_namecache_block_response (void *cls,
   const char *label = ac->label;
   const struct GNUNET_CRYPTO_EcdsaPublicKey *auth = &ac->authority_info.gns_authority;
   struct GNUNET_HashCode query;
+  struct DecryptContext dc;
 
   GNUNET_assert (NULL != rh->namecache_qe);
   rh->namecache_qe = NULL;
@@ -2092,9 +2766,9 @@ handle_namecache_block_response (void *cls,
 	 (0 == GNUNET_TIME_absolute_get_remaining (GNUNET_TIME_absolute_ntoh (block->expiration_time)).rel_value_us) ) )
   {
     /* namecache knows nothing; try DHT lookup */
-    GNUNET_GNSRECORD_query_from_public_key (auth,
-                                            label,
-                                            &query);
+    get_query (auth,
+               label,
+               &query);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Starting DHT lookup for `%s' in zone `%s' under key `%s'\n",
                 ac->label,
@@ -2107,6 +2781,15 @@ handle_namecache_block_response (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received result from namecache for label `%s'\n",
               ac->label);
+  if ( (NULL != rh->get_handle) &&
+       (NULL != block) )
+  {
+    /* namecache answered, speculative DHT lookup is not needed */
+    GNUNET_DHT_get_stop (rh->get_handle);
+    rh->get_handle = NULL;
+    GNUNET_CONTAINER_heap_remove_node (rh->dht_heap_node);
+    rh->dht_heap_node = NULL;
+  }
 
   if ( (NULL == block) ||
        (0 == GNUNET_TIME_absolute_get_remaining (GNUNET_TIME_absolute_ntoh (block->expiration_time)).rel_value_us) )
@@ -2116,22 +2799,25 @@ handle_namecache_block_response (void *cls,
 		"Resolution failed for `%s' in zone %s (DHT lookup not permitted by configuration)\n",
 		ac->label,
 		GNUNET_GNSRECORD_z2s (&ac->authority_info.gns_authority));
+    cache_negative (rh, GNUNET_NO);
     rh->proc (rh->proc_cls, 0, NULL);
     GNS_resolver_lookup_cancel (rh);
     return;
   }
+  dc.rh = rh;
+  dc.expiration = GNUNET_TIME_absolute_ntoh (block->expiration_time);
   if (GNUNET_OK !=
       GNUNET_GNSRECORD_block_decrypt (block,
 				      auth,
 				      label,
 				      &handle_gns_namecache_resolution_result,
-				      rh))
+				      &dc))
   {
     GNUNET_break_op (0); /* block was ill-formed */
     /* try DHT instead */
-    GNUNET_GNSRECORD_query_from_public_key (auth,
-                                            label,
-                                            &query);
+    get_query (auth,
+               label,
+               &query);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Starting DHT lookup for `%s' in zone `%s' under key `%s'\n",
                 ac->label,
@@ -2143,6 +2829,307 @@ handle_namecache_block_response (void *cls,
 }
 
 
+/**
+ * Stop a refresh of a cached record set.
+ *
+ * @param cr refresh to stop
+ */
+static void
+stop_refresh (struct CacheRefresh *cr)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (refreshes,
+                                                       &cr->key,
+                                                       cr));
+  if (NULL != cr->get_handle)
+    GNUNET_DHT_get_stop (cr->get_handle);
+  if (NULL != cr->timeout_task)
+    GNUNET_SCHEDULER_cancel (cr->timeout_task);
+  GNUNET_free (cr->label);
+  GNUNET_free (cr);
+}
+
+
+/**
+ * The DHT did not provide a newer block in time, give up.
+ *
+ * @param cls the `struct CacheRefresh`
+ * @param tc scheduler context
+ */
+static void
+refresh_timeout (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct CacheRefresh *cr = cls;
+
+  cr->timeout_task = NULL;
+  stop_refresh (cr);
+}
+
+
+/**
+ * Process the records decrypted from a refreshed block.
+ *
+ * @param cls the `struct CacheRefresh`
+ * @param rd_count number of entries in @a rd array
+ * @param rd array of records
+ */
+static void
+handle_refreshed_records (void *cls,
+                          unsigned int rd_count,
+                          const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct CacheRefresh *cr = cls;
+
+  cache_decrypted_records (&cr->zone,
+                           cr->label,
+                           cr->expiration,
+                           rd_count,
+                           rd);
+}
+
+
+/**
+ * Process a DHT result for a refresh of a cached record set.
+ * Blocks that are not newer than the cached one are ignored.
+ *
+ * @param cls the `struct CacheRefresh`
+ * @param exp lifetime
+ * @param key key of the result
+ * @param get_path peers on reply path (or NULL if not recorded)
+ * @param get_path_length number of entries in @a get_path
+ * @param put_path peers on the PUT path (or NULL if not recorded)
+ * @param put_path_length number of entries in @a put_path
+ * @param type type of the result
+ * @param size number of bytes in data
+ * @param data pointer to the result data
+ */
+static void
+handle_refresh_response (void *cls,
+                         struct GNUNET_TIME_Absolute exp,
+                         const struct GNUNET_HashCode *key,
+                         const struct GNUNET_PeerIdentity *get_path,
+                         unsigned int get_path_length,
+                         const struct GNUNET_PeerIdentity *put_path,
+                         unsigned int put_path_length,
+                         enum GNUNET_BLOCK_Type type,
+                         size_t size, const void *data)
+{
+  struct CacheRefresh *cr = cls;
+  const struct GNUNET_GNSRECORD_Block *block;
+  struct CacheOps *co;
+
+  if ( (size < sizeof (struct GNUNET_GNSRECORD_Block)) ||
+       (size !=
+        ntohl (((const struct GNUNET_GNSRECORD_Block *) data)->purpose.size) +
+        sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey) +
+        sizeof (struct GNUNET_CRYPTO_EcdsaSignature)) )
+  {
+    GNUNET_break (0);
+    return;
+  }
+  block = data;
+  cr->expiration = GNUNET_TIME_absolute_ntoh (block->expiration_time);
+  if (cr->expiration.abs_value_us <= cr->old_expiration.abs_value_us)
+    return; /* not newer, keep waiting */
+  if (GNUNET_OK !=
+      GNUNET_GNSRECORD_block_decrypt (block,
+                                      &cr->zone,
+                                      cr->label,
+                                      &handle_refreshed_records,
+                                      cr))
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  GNUNET_STATISTICS_update (statistics,
+                            gettext_noop ("# GNS record cache entries refreshed"),
+                            1, GNUNET_NO);
+  if (GNUNET_YES == use_cache)
+  {
+    co = GNUNET_new (struct CacheOps);
+    co->namecache_qe_cache = GNUNET_NAMECACHE_block_cache (namecache_handle,
+                                                           block,
+                                                           &namecache_cache_continuation,
+                                                           co);
+    GNUNET_CONTAINER_DLL_insert (co_head,
+                                 co_tail,
+                                 co);
+  }
+  stop_refresh (cr);
+}
+
+
+/**
+ * Refresh a cached record set from the DHT in the background if it
+ * is about to expire, so that frequently used names never have to
+ * wait for the DHT.
+ *
+ * @param rce cache entry that was just used
+ * @param zone zone of the entry
+ * @param label label of the entry
+ */
+static void
+maybe_refresh (struct RecordCacheEntry *rce,
+               const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+               const char *label)
+{
+  struct CacheRefresh *cr;
+  struct GNUNET_HashCode query;
+  uint64_t lifetime;
+
+  if ( (GNUNET_NO == refresh_ahead) ||
+       (GNUNET_YES == rce->negative) ||
+       (GNUNET_YES == rce->refresh_tried) )
+    return;
+  lifetime = rce->expiration.abs_value_us - rce->created.abs_value_us;
+  if (GNUNET_TIME_absolute_get_remaining (rce->expiration).rel_value_us >
+      lifetime / REFRESH_AHEAD_FACTOR)
+    return;
+  if ( (GNUNET_CONTAINER_multihashmap_size (refreshes) >= MAX_REFRESHES) ||
+       (NULL != GNUNET_CONTAINER_multihashmap_get (refreshes, &rce->key)) )
+    return;
+  rce->refresh_tried = GNUNET_YES;
+  cr = GNUNET_new (struct CacheRefresh);
+  cr->key = rce->key;
+  cr->zone = *zone;
+  cr->label = GNUNET_strdup (label);
+  cr->old_expiration = rce->expiration;
+  get_query (zone,
+             label,
+             &query);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Refreshing cached records for `%s' in zone %s\n",
+              label,
+              GNUNET_GNSRECORD_z2s (zone));
+  cr->get_handle = GNUNET_DHT_get_start (dht_handle,
+                                         GNUNET_BLOCK_TYPE_GNS_NAMERECORD,
+                                         &query,
+                                         DHT_GNS_REPLICATION_LEVEL,
+                                         GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE,
+                                         NULL, 0,
+                                         &handle_refresh_response, cr);
+  cr->timeout_task = GNUNET_SCHEDULER_add_delayed (DHT_LOOKUP_TIMEOUT,
+                                                   &refresh_timeout,
+                                                   cr);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (refreshes,
+                                                    &cr->key,
+                                                    cr,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+}
+
+
+/**
+ * Function called to stop a refresh during shutdown.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct CacheRefresh` to stop
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+stop_refresh_it (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  stop_refresh (value);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Check the record cache for the tail of our authority chain and
+ * continue the resolution with the cached result if we have one.
+ *
+ * @param rh query we are processing
+ * @return #GNUNET_YES if the cache answered the query (@a rh may
+ *         have been freed), #GNUNET_NO if not
+ */
+static int
+check_record_cache (struct GNS_ResolverHandle *rh)
+{
+  struct AuthorityChain *ac = rh->ac_tail;
+  struct RecordCacheEntry *rce;
+  struct GNUNET_HashCode key;
+  int dht_permitted;
+
+  if (0 == record_cache_size)
+    return GNUNET_NO;
+  get_record_cache_key (&ac->authority_info.gns_authority,
+                        ac->label,
+                        &key);
+  rce = GNUNET_CONTAINER_multihashmap_get (record_cache, &key);
+  if ( (NULL != rce) &&
+       (0 == GNUNET_TIME_absolute_get_remaining (rce->expiration).rel_value_us) )
+  {
+    free_record_cache_entry (rce);
+    rce = NULL;
+  }
+  dht_permitted = ( (GNUNET_GNS_LO_DEFAULT == rh->options) ||
+                    ( (GNUNET_GNS_LO_LOCAL_MASTER == rh->options) &&
+                      (ac != rh->ac_head) ) );
+  if ( (NULL == rce) ||
+       ( (GNUNET_YES == rce->negative) &&
+         (GNUNET_YES == dht_permitted) &&
+         (GNUNET_NO == rce->dht_checked) ) )
+  {
+    GNUNET_STATISTICS_update (statistics,
+                              gettext_noop ("# GNS record cache misses"),
+                              1, GNUNET_NO);
+    return GNUNET_NO;
+  }
+  GNUNET_CONTAINER_heap_update_cost (record_cache_lru,
+                                     rce->hn,
+                                     GNUNET_TIME_absolute_get ().abs_value_us);
+  if (GNUNET_YES == rce->negative)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Negative cache hit for `%s' in zone %s\n",
+                ac->label,
+                GNUNET_GNSRECORD_z2s (&ac->authority_info.gns_authority));
+    GNUNET_STATISTICS_update (statistics,
+                              gettext_noop ("# GNS negative record cache hits"),
+                              1, GNUNET_NO);
+    rh->proc (rh->proc_cls, 0, NULL);
+    GNS_resolver_lookup_cancel (rh);
+    return GNUNET_YES;
+  }
+  GNUNET_STATISTICS_update (statistics,
+                            gettext_noop ("# GNS record cache hits"),
+                            1, GNUNET_NO);
+  maybe_refresh (rce,
+                 &ac->authority_info.gns_authority,
+                 ac->label);
+  {
+    struct GNUNET_GNSRECORD_Data rd[rce->rd_count];
+    char data[rce->data_size];
+    unsigned int rd_count = rce->rd_count;
+
+    /* copy, as continuing the resolution may modify the cache */
+    memcpy (data, &rce[1], rce->data_size);
+    if (GNUNET_OK !=
+        GNUNET_GNSRECORD_records_deserialize (rce->data_size,
+                                              data,
+                                              rd_count,
+                                              rd))
+    {
+      GNUNET_break (0);
+      free_record_cache_entry (rce);
+      return GNUNET_NO;
+    }
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Record cache hit for `%s' in zone %s\n",
+                ac->label,
+                GNUNET_GNSRECORD_z2s (&ac->authority_info.gns_authority));
+    continue_with_records (rh,
+                           rd_count,
+                           (0 != rd_count) ? rd : NULL);
+  }
+  return GNUNET_YES;
+}
+
+
 /**
  * Lookup tail of our authority chain in the namecache.
  *
@@ -2154,15 +3141,30 @@ recursive_gns_resolution_namecache (struct GNS_ResolverHandle *rh)
   struct AuthorityChain *ac = rh->ac_tail;
   struct GNUNET_HashCode query;
 
+  if (GNUNET_YES == check_record_cache (rh))
+    return;
+
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Starting GNS resolution for `%s' in zone %s\n",
 	      ac->label,
 	      GNUNET_GNSRECORD_z2s (&ac->authority_info.gns_authority));
-  GNUNET_GNSRECORD_query_from_public_key (&ac->authority_info.gns_authority,
-					  ac->label,
-					  &query);
+  get_query (&ac->authority_info.gns_authority,
+             ac->label,
+             &query);
   if (GNUNET_YES == use_cache)
   {
+    if ( (GNUNET_YES == prefetch_delegations) &&
+         (ac != rh->ac_head) &&
+         ( (GNUNET_GNS_LO_DEFAULT == rh->options) ||
+           (GNUNET_GNS_LO_LOCAL_MASTER == rh->options) ) )
+    {
+      /* label in a delegated zone, likely not in the namecache;
+         ask the DHT right away instead of after the namecache */
+      GNUNET_STATISTICS_update (statistics,
+                                gettext_noop ("# GNS speculative DHT lookups"),
+                                1, GNUNET_NO);
+      start_dht_request (rh, &query);
+    }
     rh->namecache_qe
       = GNUNET_NAMECACHE_lookup_block (namecache_handle,
                                        &query,
@@ -2200,7 +3202,26 @@ handle_revocation_result (void *cls,
     GNS_resolver_lookup_cancel (rh);
     return;
   }
-  recursive_gns_resolution_namecache (rh);
+  if (GNUNET_NO == rh->records_deferred)
+    return; /* lookup of the records is still running */
+  {
+    struct GNUNET_GNSRECORD_Data rd[rh->deferred_rd_count];
+    char data[rh->deferred_rd_size];
+    unsigned int rd_count = rh->deferred_rd_count;
+
+    memcpy (data, rh->deferred_rd_data, rh->deferred_rd_size);
+    GNUNET_free_non_null (rh->deferred_rd_data);
+    rh->deferred_rd_data = NULL;
+    rh->records_deferred = GNUNET_NO;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_GNSRECORD_records_deserialize (rh->deferred_rd_size,
+                                                         data,
+                                                         rd_count,
+                                                         rd));
+    handle_gns_resolution_result (rh,
+                                  rd_count,
+                                  (0 != rd_count) ? rd : NULL);
+  }
 }
 
 
@@ -2248,7 +3269,11 @@ recursive_resolution (void *cls,
     return;
   }
   if (GNUNET_YES == rh->ac_tail->gns_authority)
+  {
+    /* check for revocation while we look up the records */
     recursive_gns_resolution_revocation (rh);
+    recursive_gns_resolution_namecache (rh);
+  }
   else
     recursive_dns_resolution (rh);
 }
@@ -2371,6 +3396,79 @@ start_resolver_lookup (struct GNS_ResolverHandle *rh)
 }
 
 
+/**
+ * Compute the key under which identical lookups are coalesced.
+ *
+ * @param zone the zone to perform the lookup in
+ * @param record_type the record type to look up
+ * @param name the name to look up
+ * @param shorten_key private key for use with PSEU import (can be NULL)
+ * @param options local options to control local lookup
+ * @param key set to the key of the lookup
+ */
+static void
+get_lookup_key (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                uint32_t record_type,
+                const char *name,
+                const struct GNUNET_CRYPTO_EcdsaPrivateKey *shorten_key,
+                enum GNUNET_GNS_LocalOptions options,
+                struct GNUNET_HashCode *key)
+{
+  struct GNUNET_HashContext *hc;
+  uint32_t rt = htonl (record_type);
+  uint32_t opt = htonl ((uint32_t) options);
+
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc, zone, sizeof (*zone));
+  GNUNET_CRYPTO_hash_context_read (hc, &rt, sizeof (rt));
+  GNUNET_CRYPTO_hash_context_read (hc, &opt, sizeof (opt));
+  if (NULL != shorten_key)
+    GNUNET_CRYPTO_hash_context_read (hc, shorten_key, sizeof (*shorten_key));
+  GNUNET_CRYPTO_hash_context_read (hc, name, strlen (name) + 1);
+  GNUNET_CRYPTO_hash_context_finish (hc, key);
+}
+
+
+/**
+ * Result processor of lookups started via #GNS_resolver_lookup():
+ * passes the result to all lookups that were attached to this one
+ * and to the client of the lookup itself.
+ *
+ * @param cls the leading `struct GNS_ResolverHandle`
+ * @param rd_count number of records in @a rd
+ * @param rd records returned for the lookup
+ */
+static void
+fan_out_result (void *cls,
+                uint32_t rd_count,
+                const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct GNS_ResolverHandle *rh = cls;
+  struct GNS_ResolverHandle *f;
+
+  if (GNUNET_YES == rh->in_active_lookups)
+  {
+    /* result is final, later lookups must start afresh */
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (active_lookups,
+                                                         &rh->lookup_key,
+                                                         rh));
+    rh->in_active_lookups = GNUNET_NO;
+  }
+  while (NULL != (f = rh->follower_head))
+  {
+    GNUNET_CONTAINER_MDLL_remove (follower,
+                                  rh->follower_head,
+                                  rh->follower_tail,
+                                  f);
+    f->proc (f->proc_cls, rd_count, rd);
+    GNUNET_free (f);
+  }
+  if (NULL != rh->client_proc)
+    rh->client_proc (rh->client_proc_cls, rd_count, rd);
+}
+
+
 /**
  * Lookup of a record in a specific zone calls lookup result processor
  * on result.
@@ -2393,7 +3491,29 @@ GNS_resolver_lookup (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
 		     GNS_ResultProcessor proc, void *proc_cls)
 {
   struct GNS_ResolverHandle *rh;
+  struct GNS_ResolverHandle *leader;
+  struct GNUNET_HashCode key;
 
+  get_lookup_key (zone, record_type, name, shorten_key, options, &key);
+  leader = GNUNET_CONTAINER_multihashmap_get (active_lookups, &key);
+  if (NULL != leader)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Attaching lookup for `%s' to identical running lookup\n",
+                name);
+    GNUNET_STATISTICS_update (statistics,
+                              gettext_noop ("# GNS lookups coalesced"),
+                              1, GNUNET_NO);
+    rh = GNUNET_new (struct GNS_ResolverHandle);
+    rh->leader = leader;
+    rh->proc = proc;
+    rh->proc_cls = proc_cls;
+    GNUNET_CONTAINER_MDLL_insert_tail (follower,
+                                       leader->follower_head,
+                                       leader->follower_tail,
+                                       rh);
+    return rh;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      (NULL == shorten_key)
 	      ? "Starting lookup for `%s' with shortening disabled\n"
@@ -2404,8 +3524,17 @@ GNS_resolver_lookup (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
 			       rlh_tail,
 			       rh);
   rh->authority_zone = *zone;
-  rh->proc = proc;
-  rh->proc_cls = proc_cls;
+  rh->proc = &fan_out_result;
+  rh->proc_cls = rh;
+  rh->client_proc = proc;
+  rh->client_proc_cls = proc_cls;
+  rh->lookup_key = key;
+  rh->in_active_lookups = GNUNET_YES;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (active_lookups,
+                                                    &rh->lookup_key,
+                                                    rh,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
   rh->options = options;
   rh->record_type = record_type;
   rh->name = GNUNET_strdup (name);
@@ -2431,10 +3560,50 @@ GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh)
   struct DnsResult *dr;
   struct AuthorityChain *ac;
   struct VpnContext *vpn_ctx;
+  struct GNS_ResolverHandle *leader;
+  struct GNUNET_TIME_Absolute start;
 
+  if (NULL != (leader = rh->leader))
+  {
+    /* only detach from the lookup doing the work */
+    GNUNET_CONTAINER_MDLL_remove (follower,
+                                  leader->follower_head,
+                                  leader->follower_tail,
+                                  rh);
+    GNUNET_free (rh);
+    if ( (NULL == leader->client_proc) &&
+         (NULL == leader->follower_head) )
+      GNS_resolver_lookup_cancel (leader); /* nobody is interested anymore */
+    return;
+  }
+  if (NULL != rh->follower_head)
+  {
+    /* our client is gone, but others still wait for the result */
+    rh->client_proc = NULL;
+    rh->client_proc_cls = NULL;
+    return;
+  }
+  if (GNUNET_YES == rh->in_active_lookups)
+  {
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (active_lookups,
+                                                         &rh->lookup_key,
+                                                         rh));
+    rh->in_active_lookups = GNUNET_NO;
+  }
   GNUNET_CONTAINER_DLL_remove (rlh_head,
 			       rlh_tail,
 			       rh);
+  if (NULL != rh->dht_heap_node)
+  {
+    start.abs_value_us = GNUNET_CONTAINER_heap_node_get_cost (rh->dht_heap_node);
+    if (GNUNET_TIME_absolute_get_duration (start).rel_value_us >=
+        NEGATIVE_DHT_MIN_AGE.rel_value_us)
+    {
+      /* the DHT did not know the label for quite a while */
+      cache_negative (rh, GNUNET_YES);
+    }
+  }
   while (NULL != (ac = rh->ac_head))
   {
     GNUNET_CONTAINER_DLL_remove (rh->ac_head,
@@ -2511,6 +3680,7 @@ GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh)
 				 dr);
     GNUNET_free (dr);
   }
+  GNUNET_free_non_null (rh->deferred_rd_data);
   GNUNET_free_non_null (rh->shorten_key);
   GNUNET_free (rh->name);
   GNUNET_free (rh);
@@ -2526,12 +3696,14 @@ GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh)
  * @param nc the namecache handle
  * @param dht the dht handle
  * @param c configuration handle
+ * @param stats statistics handle
  * @param max_bg_queries maximum number of parallel background queries in dht
  */
 void
 GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
 		   struct GNUNET_DHT_Handle *dht,
 		   const struct GNUNET_CONFIGURATION_Handle *c,
+                   struct GNUNET_STATISTICS_Handle *stats,
 		   unsigned long long max_bg_queries)
 {
   char *dns_ip;
@@ -2539,6 +3711,7 @@ GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
   cfg = c;
   namecache_handle = nc;
   dht_handle = dht;
+  statistics = stats;
   dht_lookup_heap =
     GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   max_allowed_background_queries = max_bg_queries;
@@ -2548,6 +3721,36 @@ GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
     use_cache = GNUNET_YES;
   if (GNUNET_NO == use_cache)
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "Namecache disabled\n");
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (c,
+                                             "gns",
+                                             "RECORD_CACHE_SIZE",
+                                             &record_cache_size))
+    record_cache_size = DEFAULT_RECORD_CACHE_SIZE;
+  if (GNUNET_NO == use_cache)
+    record_cache_size = 0; /* always ask the DHT */
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (c,
+                                           "gns",
+                                           "NEGATIVE_CACHE_TTL",
+                                           &negative_cache_ttl))
+    negative_cache_ttl = DEFAULT_NEGATIVE_CACHE_TTL;
+  prefetch_delegations = GNUNET_CONFIGURATION_get_value_yesno (c,
+                                                               "gns",
+                                                               "PREFETCH_DELEGATIONS");
+  if (GNUNET_SYSERR == prefetch_delegations)
+    prefetch_delegations = GNUNET_YES;
+  refresh_ahead = GNUNET_CONFIGURATION_get_value_yesno (c,
+                                                        "gns",
+                                                        "REFRESH_AHEAD");
+  if (GNUNET_SYSERR == refresh_ahead)
+    refresh_ahead = GNUNET_YES;
+  refreshes = GNUNET_CONTAINER_multihashmap_create (MAX_REFRESHES, GNUNET_NO);
+  active_lookups = GNUNET_CONTAINER_multihashmap_create (64, GNUNET_NO);
+  record_cache = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
+  record_cache_lru = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  query_contexts = GNUNET_CONTAINER_multihashmap_create (MAX_QUERY_CONTEXTS, GNUNET_NO);
+  query_context_lru = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
 
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_string (c,
@@ -2572,6 +3775,7 @@ GNS_resolver_done ()
 {
   struct GNS_ResolverHandle *rh;
   struct CacheOps *co;
+  struct ZoneQueryContext *zqc;
 
   /* abort active resolutions */
   while (NULL != (rh = rlh_head))
@@ -2589,12 +3793,57 @@ GNS_resolver_done ()
   }
   GNUNET_CONTAINER_heap_destroy (dht_lookup_heap);
   dht_lookup_heap = NULL;
+  GNUNET_assert (0 == GNUNET_CONTAINER_multihashmap_size (active_lookups));
+  GNUNET_CONTAINER_multihashmap_destroy (active_lookups);
+  active_lookups = NULL;
+  GNUNET_CONTAINER_multihashmap_iterate (refreshes,
+                                         &stop_refresh_it,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (refreshes);
+  refreshes = NULL;
+  GNUNET_CONTAINER_multihashmap_iterate (record_cache,
+                                         &free_record_cache_entry_it,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (record_cache);
+  record_cache = NULL;
+  GNUNET_CONTAINER_heap_destroy (record_cache_lru);
+  record_cache_lru = NULL;
+  while (NULL != (zqc = GNUNET_CONTAINER_heap_peek (query_context_lru)))
+    free_zone_query_context (zqc);
+  GNUNET_CONTAINER_multihashmap_destroy (query_contexts);
+  query_contexts = NULL;
+  GNUNET_CONTAINER_heap_destroy (query_context_lru);
+  query_context_lru = NULL;
   GNUNET_DNSSTUB_stop (dns_handle);
   dns_handle = NULL;
   GNUNET_VPN_disconnect (vpn_handle);
   vpn_handle = NULL;
   dht_handle = NULL;
   namecache_handle = NULL;
+  statistics = NULL;
+}
+
+
+/**
+ * Drop the cached records for @a label in @a zone, i.e. because
+ * the records were changed locally.
+ *
+ * @param zone the zone
+ * @param label the label
+ */
+void
+GNS_resolver_invalidate (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                         const char *label)
+{
+  struct RecordCacheEntry *rce;
+  struct GNUNET_HashCode key;
+
+  if (NULL == record_cache)
+    return;
+  get_record_cache_key (zone, label, &key);
+  rce = GNUNET_CONTAINER_multihashmap_get (record_cache, &key);
+  if (NULL != rce)
+    free_record_cache_entry (rce);
 }
 
 
@@ -28,6 +28,7 @@
 #include "gnunet_dht_service.h"
 #include "gnunet_gns_service.h"
 #include "gnunet_namecache_service.h"
+#include "gnunet_statistics_service.h"
 
 /**
  * Initialize the resolver subsystem.
@@ -36,12 +37,14 @@
  * @param nc the namecache handle
  * @param dht handle to the dht
  * @param c configuration handle
+ * @param stats statistics handle
  * @param max_bg_queries maximum amount of background queries
  */
 void
 GNS_resolver_init (struct GNUNET_NAMECACHE_Handle *nc,
 		   struct GNUNET_DHT_Handle *dht,
 		   const struct GNUNET_CONFIGURATION_Handle *c,
+                   struct GNUNET_STATISTICS_Handle *stats,
 		   unsigned long long max_bg_queries);
 
 
@@ -72,7 +75,8 @@ typedef void (*GNS_ResultProcessor)(void *cls,
 
 /**
  * Lookup of a record in a specific zone
- * calls RecordLookupProcessor on result or timeout
+ * calls RecordLookupProcessor on result or timeout.
+ * Concurrent lookups with identical arguments share one resolution.
  *
  * @param zone the zone to perform the lookup in
  * @param record_type the record type to look up
@@ -102,6 +106,18 @@ void
 GNS_resolver_lookup_cancel (struct GNS_ResolverHandle *rh);
 
 
+/**
+ * Drop the cached records for @a label in @a zone, i.e. because
+ * the records were changed locally.
+ *
+ * @param zone the zone
+ * @param label the label
+ */
+void
+GNS_resolver_invalidate (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone,
+                         const char *label);
+
+
 
 
 /**
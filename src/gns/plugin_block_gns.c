@@ -30,10 +30,9 @@
 #include "gnunet_signatures.h"
 
 /**
- * Number of bits we set per entry in the bloomfilter.
- * Do not change! -from fs
+ * Number of block verification results we remember.
  */
-#define BLOOMFILTER_K 16
+#define VERIFICATION_CACHE_SIZE 256
 
 /**
  * Function called to validate a reply or a request.  For
@@ -66,10 +65,11 @@ block_plugin_gns_evaluate (void *cls,
                            const void *reply_block,
                            size_t reply_block_size)
 {
+  struct GNUNET_BLOCK_VerificationCache *cache = cls;
   const struct GNUNET_GNSRECORD_Block *block;
   struct GNUNET_HashCode h;
   struct GNUNET_HashCode chash;
-  struct GNUNET_HashCode mhash;
+  int ret;
 
   if (type != GNUNET_BLOCK_TYPE_GNS_NAMERECORD)
     return GNUNET_BLOCK_EVALUATION_TYPE_NOT_SUPPORTED;
@@ -104,27 +104,24 @@ block_plugin_gns_evaluate (void *cls,
       GNUNET_break_op (0);
       return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
     }
-  if (GNUNET_OK !=
-      GNUNET_GNSRECORD_block_verify (block))
+  /* the same block usually reaches us on several routes, only
+     check its signature the first time */
+  GNUNET_CRYPTO_hash (reply_block, reply_block_size, &chash);
+  ret = GNUNET_BLOCK_verification_cache_get (cache, &chash);
+  if (GNUNET_NO == ret)
     {
-      GNUNET_break_op (0);
-      return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
+      ret = GNUNET_GNSRECORD_block_verify (block);
+      GNUNET_BLOCK_verification_cache_put (cache, &chash,
+                                           (GNUNET_OK == ret) ? GNUNET_OK : GNUNET_SYSERR);
     }
-  if (NULL != bf)
+  if (GNUNET_OK != ret)
     {
-      GNUNET_CRYPTO_hash (reply_block, reply_block_size, &chash);
-      GNUNET_BLOCK_mingle_hash (&chash, bf_mutator, &mhash);
-      if (NULL != *bf)
-	{
-	  if (GNUNET_YES == GNUNET_CONTAINER_bloomfilter_test(*bf, &mhash))
-	    return GNUNET_BLOCK_EVALUATION_OK_DUPLICATE;
-	}
-      else
-	{
-	  *bf = GNUNET_CONTAINER_bloomfilter_init(NULL, 8, BLOOMFILTER_K);
-	}
-      GNUNET_CONTAINER_bloomfilter_add(*bf, &mhash);
+      GNUNET_break_op (0);
+      return GNUNET_BLOCK_EVALUATION_RESULT_INVALID;
     }
+  if (GNUNET_YES ==
+      GNUNET_BLOCK_check_reply_filter (bf, bf_mutator, &chash))
+    return GNUNET_BLOCK_EVALUATION_OK_DUPLICATE;
   return GNUNET_BLOCK_EVALUATION_OK_MORE;
 }
 
@@ -176,6 +173,7 @@ libgnunet_plugin_block_gns_init (void *cls)
   struct GNUNET_BLOCK_PluginFunctions *api;
 
   api = GNUNET_new (struct GNUNET_BLOCK_PluginFunctions);
+  api->cls = GNUNET_BLOCK_verification_cache_create (VERIFICATION_CACHE_SIZE);
   api->evaluate = &block_plugin_gns_evaluate;
   api->get_key = &block_plugin_gns_get_key;
   api->types = types;
@@ -189,8 +187,9 @@ libgnunet_plugin_block_gns_init (void *cls)
 void *
 libgnunet_plugin_block_gns_done (void *cls)
 {
-  struct GNUNET_TRANSPORT_PluginFunctions *api = cls;
+  struct GNUNET_BLOCK_PluginFunctions *api = cls;
 
+  GNUNET_BLOCK_verification_cache_destroy (api->cls);
   GNUNET_free (api);
   return NULL;
 }
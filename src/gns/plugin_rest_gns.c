@@ -54,14 +54,29 @@
 struct Plugin
 {
   const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+  /**
+   * Handle to GNS service, shared by all lookups.
+   */
+  struct GNUNET_GNS_Handle *gns;
+
+  /**
+   * Handle to the identity service, shared by all lookups.
+   */
+  struct GNUNET_IDENTITY_Handle *identity;
 };
 
 const struct GNUNET_CONFIGURATION_Handle *cfg;
 
+/**
+ * The plugin
+ */
+static struct Plugin plugin;
+
 struct LookupHandle
 {
   /**
-   * Handle to GNS service.
+   * Handle to GNS service (owned by the plugin).
    */
   struct GNUNET_GNS_Handle *gns;
 
@@ -81,7 +96,7 @@ struct LookupHandle
   struct GNUNET_IDENTITY_EgoLookup *el;
 
   /**
-   * Handle for identity service.
+   * Handle for identity service (owned by the plugin).
    */
   struct GNUNET_IDENTITY_Handle *identity;
 
@@ -185,17 +200,6 @@ cleanup_handle (struct LookupHandle *handle)
     GNUNET_GNS_lookup_cancel (handle->lookup_request);
     handle->lookup_request = NULL;
   }
-  if (NULL != handle->identity)
-  {
-    GNUNET_IDENTITY_disconnect (handle->identity);
-    handle->identity = NULL;
-  }
-  if (NULL != handle->gns)
-  {
-    GNUNET_GNS_disconnect (handle->gns);
-    handle->gns = NULL;
-  }
-
   if (NULL != handle->timeout_task)
   {
     GNUNET_SCHEDULER_cancel (handle->timeout_task);
@@ -519,8 +523,12 @@ get_gns_cont (struct RestConnectionDataHandle *conndata_handle,
   }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Connecting...\n");
-  handle->gns = GNUNET_GNS_connect (cfg);
-  handle->identity = GNUNET_IDENTITY_connect (cfg, NULL, NULL);
+  if (NULL == plugin.gns)
+    plugin.gns = GNUNET_GNS_connect (cfg);
+  if (NULL == plugin.identity)
+    plugin.identity = GNUNET_IDENTITY_connect (cfg, NULL, NULL);
+  handle->gns = plugin.gns;
+  handle->identity = plugin.identity;
   handle->timeout_task = GNUNET_SCHEDULER_add_delayed (handle->timeout,
                                                        &do_error, handle);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -680,7 +688,6 @@ rest_gns_process_request(struct RestConnectionDataHandle *conndata_handle,
 void *
 libgnunet_plugin_rest_gns_init (void *cls)
 {
-  static struct Plugin plugin;
   cfg = cls;
   struct GNUNET_REST_Plugin *api;
 
@@ -710,6 +717,16 @@ libgnunet_plugin_rest_gns_done (void *cls)
   struct GNUNET_REST_Plugin *api = cls;
   struct Plugin *plugin = api->cls;
 
+  if (NULL != plugin->identity)
+  {
+    GNUNET_IDENTITY_disconnect (plugin->identity);
+    plugin->identity = NULL;
+  }
+  if (NULL != plugin->gns)
+  {
+    GNUNET_GNS_disconnect (plugin->gns);
+    plugin->gns = NULL;
+  }
   plugin->cfg = NULL;
   GNUNET_free (api);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -68,6 +68,52 @@ static unsigned int num_plugins;
  */
 static int once;
 
+/**
+ * Map from record types to the `struct Plugin` that last
+ * handled the type.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *type_cache;
+
+/**
+ * Map from #typename_key() of type names to the `struct Plugin`
+ * that last converted the name.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *typename_cache;
+
+
+/**
+ * Compute a case-insensitive key for a type name.
+ *
+ * @param dns_typename name to compute the key for
+ * @return key for #typename_cache
+ */
+static uint32_t
+typename_key (const char *dns_typename)
+{
+  uint32_t key = 5381;
+
+  for (; '\0' != *dns_typename; dns_typename++)
+    key = key * 33 + toupper ((unsigned char) *dns_typename);
+  return key;
+}
+
+
+/**
+ * Remember which plugin handled a record type.
+ *
+ * @param type the record type
+ * @param plugin plugin that handled @a type
+ */
+static void
+cache_type (uint32_t type,
+            struct Plugin *plugin)
+{
+  (void) GNUNET_CONTAINER_multihashmap32_put (type_cache,
+                                              type,
+                                              plugin,
+                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
+}
+
 
 /**
  * Add a plugin to the list managed by the block library.
@@ -103,6 +149,8 @@ init ()
   if (1 == once)
     return;
   once = 1;
+  type_cache = GNUNET_CONTAINER_multihashmap32_create (32);
+  typename_cache = GNUNET_CONTAINER_multihashmap32_create (32);
   GNUNET_PLUGIN_load_all ("libgnunet_plugin_gnsrecord_", NULL,
                           &add_plugin, NULL);
 }
@@ -128,6 +176,16 @@ GNSRECORD_fini ()
   }
   GNUNET_free_non_null (gns_plugins);
   gns_plugins = NULL;
+  if (NULL != type_cache)
+  {
+    GNUNET_CONTAINER_multihashmap32_destroy (type_cache);
+    type_cache = NULL;
+  }
+  if (NULL != typename_cache)
+  {
+    GNUNET_CONTAINER_multihashmap32_destroy (typename_cache);
+    typename_cache = NULL;
+  }
   once = 0;
   num_plugins = 0;
 }
@@ -151,6 +209,14 @@ GNUNET_GNSRECORD_value_to_string (uint32_t type,
   char *ret;
 
   init ();
+  plugin = GNUNET_CONTAINER_multihashmap32_get (type_cache,
+                                                type);
+  if ( (NULL != plugin) &&
+       (NULL != (ret = plugin->api->value_to_string (plugin->api->cls,
+                                                     type,
+                                                     data,
+                                                     data_size))) )
+    return ret;
   for (i = 0; i < num_plugins; i++)
   {
     plugin = gns_plugins[i];
@@ -158,7 +224,10 @@ GNUNET_GNSRECORD_value_to_string (uint32_t type,
                                                      type,
                                                      data,
                                                      data_size)))
+    {
+      cache_type (type, plugin);
       return ret;
+    }
   }
   return NULL;
 }
@@ -184,6 +253,15 @@ GNUNET_GNSRECORD_string_to_value (uint32_t type,
   struct Plugin *plugin;
 
   init ();
+  plugin = GNUNET_CONTAINER_multihashmap32_get (type_cache,
+                                                type);
+  if ( (NULL != plugin) &&
+       (GNUNET_OK == plugin->api->string_to_value (plugin->api->cls,
+                                                   type,
+                                                   s,
+                                                   data,
+                                                   data_size)) )
+    return GNUNET_OK;
   for (i = 0; i < num_plugins; i++)
   {
     plugin = gns_plugins[i];
@@ -192,7 +270,10 @@ GNUNET_GNSRECORD_string_to_value (uint32_t type,
                                                    s,
                                                    data,
                                                    data_size))
+    {
+      cache_type (type, plugin);
       return GNUNET_OK;
+    }
   }
   return GNUNET_SYSERR;
 }
@@ -209,18 +290,33 @@ GNUNET_GNSRECORD_typename_to_number (const char *dns_typename)
 {
   unsigned int i;
   struct Plugin *plugin;
+  uint32_t key;
   uint32_t ret;
 
   if (0 == strcasecmp (dns_typename,
                        "ANY"))
     return GNUNET_GNSRECORD_TYPE_ANY;
   init ();
+  key = typename_key (dns_typename);
+  plugin = GNUNET_CONTAINER_multihashmap32_get (typename_cache,
+                                                key);
+  /* keys may collide, so the plugin still has to confirm the name */
+  if ( (NULL != plugin) &&
+       (UINT32_MAX != (ret = plugin->api->typename_to_number (plugin->api->cls,
+                                                              dns_typename))) )
+    return ret;
   for (i = 0; i < num_plugins; i++)
   {
     plugin = gns_plugins[i];
     if (UINT32_MAX != (ret = plugin->api->typename_to_number (plugin->api->cls,
                                                               dns_typename)))
+    {
+      (void) GNUNET_CONTAINER_multihashmap32_put (typename_cache,
+                                                  key,
+                                                  plugin,
+                                                  GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
       return ret;
+    }
   }
   return UINT32_MAX;
 }
@@ -242,12 +338,21 @@ GNUNET_GNSRECORD_number_to_typename (uint32_t type)
   if (GNUNET_GNSRECORD_TYPE_ANY == type)
     return "ANY";
   init ();
+  plugin = GNUNET_CONTAINER_multihashmap32_get (type_cache,
+                                                type);
+  if ( (NULL != plugin) &&
+       (NULL != (ret = plugin->api->number_to_typename (plugin->api->cls,
+                                                        type))) )
+    return ret;
   for (i = 0; i < num_plugins; i++)
   {
     plugin = gns_plugins[i];
     if (NULL != (ret = plugin->api->number_to_typename (plugin->api->cls,
                                                         type)))
+    {
+      cache_type (type, plugin);
       return ret;
+    }
   }
   return NULL;
 }
@@ -69,27 +69,31 @@ derive_block_aes_key (struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
 
 
 /**
- * Sign name and records
+ * Sign name and records with keys that were derived for @a label in
+ * advance.  Does not log or use the scheduler, so it may be run in
+ * the crypto offload pool.
  *
- * @param key the private key
+ * @param dkey private key derived from the zone key for @a label
+ * @param dpub public key of @a dkey
+ * @param zone_pub public key of the zone
  * @param expire block expiration
  * @param label the name for the records
  * @param rd record data
  * @param rd_count number of records
- * @return NULL on error (block too large)
+ * @return NULL on error (block too large, signing failed)
  */
 struct GNUNET_GNSRECORD_Block *
-GNUNET_GNSRECORD_block_create (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
-			       struct GNUNET_TIME_Absolute expire,
-			       const char *label,
-			       const struct GNUNET_GNSRECORD_Data *rd,
-			       unsigned int rd_count)
+GNUNET_GNSRECORD_block_create_derived (const struct GNUNET_CRYPTO_EcdsaPrivateKey *dkey,
+                                       const struct GNUNET_CRYPTO_EcdsaPublicKey *dpub,
+                                       const struct GNUNET_CRYPTO_EcdsaPublicKey *zone_pub,
+                                       struct GNUNET_TIME_Absolute expire,
+                                       const char *label,
+                                       const struct GNUNET_GNSRECORD_Data *rd,
+                                       unsigned int rd_count)
 {
   size_t payload_len = GNUNET_GNSRECORD_records_get_size (rd_count, rd);
   char payload[sizeof (uint32_t) + payload_len];
   struct GNUNET_GNSRECORD_Block *block;
-  struct GNUNET_CRYPTO_EcdsaPublicKey pkey;
-  struct GNUNET_CRYPTO_EcdsaPrivateKey *dkey;
   struct GNUNET_CRYPTO_SymmetricInitializationVector iv;
   struct GNUNET_CRYPTO_SymmetricSessionKey skey;
   struct GNUNET_GNSRECORD_Data rdc[rd_count];
@@ -117,9 +121,10 @@ GNUNET_GNSRECORD_block_create (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
   /* serialize */
   rd_count_nbo = htonl (rd_count);
   memcpy (payload, &rd_count_nbo, sizeof (uint32_t));
-  GNUNET_assert (payload_len ==
-		 GNUNET_GNSRECORD_records_serialize (rd_count, rdc,
-						     payload_len, &payload[sizeof (uint32_t)]));
+  if (payload_len !=
+      GNUNET_GNSRECORD_records_serialize (rd_count, rdc,
+                                          payload_len, &payload[sizeof (uint32_t)]))
+    return NULL;
   block = GNUNET_malloc (sizeof (struct GNUNET_GNSRECORD_Block) +
 			 sizeof (uint32_t) + payload_len);
   block->purpose.size = htonl (sizeof (uint32_t) + payload_len +
@@ -128,28 +133,64 @@ GNUNET_GNSRECORD_block_create (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
   block->purpose.purpose = htonl (GNUNET_SIGNATURE_PURPOSE_GNS_RECORD_SIGN);
   block->expiration_time = GNUNET_TIME_absolute_hton (expire);
   /* encrypt and sign */
+  block->derived_key = *dpub;
+  derive_block_aes_key (&iv, &skey, label, zone_pub);
+  if ( (payload_len + sizeof (uint32_t) !=
+        GNUNET_CRYPTO_symmetric_encrypt (payload, payload_len + sizeof (uint32_t),
+                                         &skey, &iv,
+                                         &block[1])) ||
+       (GNUNET_OK !=
+        GNUNET_CRYPTO_ecdsa_sign (dkey,
+                                  &block->purpose,
+                                  &block->signature)) )
+  {
+    GNUNET_free (block);
+    return NULL;
+  }
+  return block;
+}
+
+
+/**
+ * Sign name and records
+ *
+ * @param key the private key
+ * @param expire block expiration
+ * @param label the name for the records
+ * @param rd record data
+ * @param rd_count number of records
+ * @return NULL on error (block too large)
+ */
+struct GNUNET_GNSRECORD_Block *
+GNUNET_GNSRECORD_block_create (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
+			       struct GNUNET_TIME_Absolute expire,
+			       const char *label,
+			       const struct GNUNET_GNSRECORD_Data *rd,
+			       unsigned int rd_count)
+{
+  struct GNUNET_GNSRECORD_Block *block;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pkey;
+  struct GNUNET_CRYPTO_EcdsaPublicKey dpub;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey *dkey;
+
+  if (GNUNET_GNSRECORD_records_get_size (rd_count, rd) >
+      GNUNET_GNSRECORD_MAX_BLOCK_SIZE)
+    return NULL;
   dkey = GNUNET_CRYPTO_ecdsa_private_key_derive (key,
                                                  label,
                                                  "gns");
   GNUNET_CRYPTO_ecdsa_key_get_public (dkey,
-				    &block->derived_key);
+				    &dpub);
   GNUNET_CRYPTO_ecdsa_key_get_public (key,
 				    &pkey);
-  derive_block_aes_key (&iv, &skey, label, &pkey);
-  GNUNET_break (payload_len + sizeof (uint32_t) ==
-		GNUNET_CRYPTO_symmetric_encrypt (payload, payload_len + sizeof (uint32_t),
-                                                 &skey, &iv,
-                                                 &block[1]));
-  if (GNUNET_OK !=
-      GNUNET_CRYPTO_ecdsa_sign (dkey,
-			      &block->purpose,
-			      &block->signature))
-  {
-    GNUNET_break (0);
-    GNUNET_free (dkey);
-    GNUNET_free (block);
-    return NULL;
-  }
+  block = GNUNET_GNSRECORD_block_create_derived (dkey,
+                                                 &dpub,
+                                                 &pkey,
+                                                 expire,
+                                                 label,
+                                                 rd,
+                                                 rd_count);
+  GNUNET_break (NULL != block);
   GNUNET_free (dkey);
   return block;
 }
@@ -328,4 +369,66 @@ GNUNET_GNSRECORD_query_from_public_key (const struct GNUNET_CRYPTO_EcdsaPublicKe
 }
 
 
+/**
+ * Context for calculating the DHT queries of many labels in one zone.
+ */
+struct GNUNET_GNSRECORD_QueryContext
+{
+  /**
+   * Key derivation context for the zone key.
+   */
+  struct GNUNET_CRYPTO_EcdsaDeriveContext *dc;
+};
+
+
+/**
+ * Create a context for calculating the DHT queries of labels in
+ * @a zone.
+ *
+ * @param zone public key of the zone
+ * @return the query context
+ */
+struct GNUNET_GNSRECORD_QueryContext *
+GNUNET_GNSRECORD_query_context_create (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone)
+{
+  struct GNUNET_GNSRECORD_QueryContext *qc;
+
+  qc = GNUNET_new (struct GNUNET_GNSRECORD_QueryContext);
+  qc->dc = GNUNET_CRYPTO_ecdsa_derive_context_create (zone, "gns");
+  return qc;
+}
+
+
+/**
+ * Calculate the DHT query for a given @a label in the zone of @a qc.
+ *
+ * @param qc query context of the zone
+ * @param label label of the record
+ * @param query hash to use for the query
+ */
+void
+GNUNET_GNSRECORD_query_from_context (struct GNUNET_GNSRECORD_QueryContext *qc,
+                                     const char *label,
+                                     struct GNUNET_HashCode *query)
+{
+  struct GNUNET_CRYPTO_EcdsaPublicKey pd;
+
+  GNUNET_CRYPTO_ecdsa_derive_context_public_key (qc->dc, label, &pd);
+  GNUNET_CRYPTO_hash (&pd, sizeof (pd), query);
+}
+
+
+/**
+ * Destroy a query context.
+ *
+ * @param qc context to destroy
+ */
+void
+GNUNET_GNSRECORD_query_context_destroy (struct GNUNET_GNSRECORD_QueryContext *qc)
+{
+  GNUNET_CRYPTO_ecdsa_derive_context_destroy (qc->dc);
+  GNUNET_free (qc);
+}
+
+
 /* end of gnsrecord_crypto.c */
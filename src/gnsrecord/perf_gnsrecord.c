@@ -0,0 +1,124 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file gnsrecord/perf_gnsrecord.c
+ * @brief measure performance of deriving DHT queries and of creating
+ *        and verifying blocks
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_dnsparser_lib.h"
+#include "gnunet_gnsrecord_lib.h"
+#include <gauger.h>
+
+/**
+ * Number of labels to use per measurement.
+ */
+#define ROUNDS 100
+
+static struct GNUNET_TIME_Absolute start;
+
+
+static void
+log_duration (const char *description,
+              unsigned int rounds)
+{
+  struct GNUNET_TIME_Relative t;
+
+  t = GNUNET_TIME_absolute_get_duration (start);
+  t = GNUNET_TIME_relative_divide (t, rounds);
+  FPRINTF (stdout,
+           "%30s: %10s\n",
+           description,
+           GNUNET_STRINGS_relative_time_to_string (t,
+                                                   GNUNET_NO));
+  GAUGER ("GNSRECORD", description, t.rel_value_us, "us");
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_CRYPTO_EcdsaPrivateKey *zone;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pub;
+  struct GNUNET_GNSRECORD_QueryContext *qc;
+  struct GNUNET_GNSRECORD_Block *blocks[ROUNDS];
+  struct GNUNET_GNSRECORD_Data rd;
+  struct GNUNET_HashCode query;
+  struct GNUNET_HashCode qquery;
+  char labels[ROUNDS][16];
+  char data[64];
+  unsigned int i;
+
+  GNUNET_log_setup ("perf-gnsrecord",
+                    "WARNING",
+                    NULL);
+  zone = GNUNET_CRYPTO_ecdsa_key_create ();
+  GNUNET_CRYPTO_ecdsa_key_get_public (zone, &pub);
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_snprintf (labels[i], sizeof (labels[i]), "label%u", i);
+  memset (data, 'a', sizeof (data));
+  rd.data = data;
+  rd.data_size = sizeof (data);
+  rd.expiration_time = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS).abs_value_us;
+  rd.record_type = GNUNET_DNSPARSER_TYPE_TXT;
+  rd.flags = GNUNET_GNSRECORD_RF_NONE;
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_GNSRECORD_query_from_public_key (&pub, labels[i], &query);
+  log_duration ("query from public key", ROUNDS);
+
+  start = GNUNET_TIME_absolute_get ();
+  qc = GNUNET_GNSRECORD_query_context_create (&pub);
+  log_duration ("create query context", 1);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_GNSRECORD_query_from_context (qc, labels[i], &qquery);
+  log_duration ("query from context", ROUNDS);
+  GNUNET_GNSRECORD_query_from_public_key (&pub, labels[ROUNDS - 1], &query);
+  GNUNET_assert (0 == memcmp (&query, &qquery, sizeof (query)));
+  GNUNET_GNSRECORD_query_context_destroy (qc);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_assert (NULL !=
+                   (blocks[i] = GNUNET_GNSRECORD_block_create (zone,
+                                                               GNUNET_TIME_UNIT_FOREVER_ABS,
+                                                               labels[i],
+                                                               &rd,
+                                                               1)));
+  log_duration ("create block", ROUNDS);
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_GNSRECORD_block_verify (blocks[i]));
+  log_duration ("verify block", ROUNDS);
+
+  for (i = 0; i < ROUNDS; i++)
+    GNUNET_free (blocks[i]);
+  GNUNET_free (zone);
+  return 0;
+}
+
+/* end of perf_gnsrecord.c */
@@ -814,4 +814,9 @@ libgnunet_plugin_gnsrecord_dns_done (void *cls)
   return NULL;
 }
 
+
+#ifdef GNUNET_GNSRECORD_STATIC_PLUGINS
+GNUNET_PLUGIN_STATIC (libgnunet_plugin_gnsrecord_dns)
+#endif
+
 /* end of plugin_gnsrecord_dns.c */
@@ -350,150 +350,477 @@ GNUNET_HELLO_iterate_addresses (const struct GNUNET_HELLO_Message *msg,
 
 
 /**
- * Closure for #get_match_exp().
+ * Entry in the address index of a `struct GNUNET_HELLO_Parsed`.
+ * All pointers point into the serialized HELLO of the parsed HELLO.
  */
-struct ExpireContext
+struct ParsedAddress
 {
   /**
-   * Address we are looking for.
+   * Name of the transport plugin (0-terminated).
    */
-  const struct GNUNET_HELLO_Address *address;
+  const char *transport_name;
 
   /**
-   * Set to #GNUNET_YES if we found the @e address.
+   * The address (possibly unaligned).
    */
-  int found;
+  const void *address;
 
   /**
-   * Set to the expiration of the match if @e found is #GNUNET_YES.
+   * When does the address expire?
    */
   struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Hash over transport name and address; the index is sorted by
+   * this key first so that most comparisons do not need to look
+   * at the address itself.
+   */
+  uint32_t key;
+
+  /**
+   * Number of bytes in @e address.
+   */
+  uint16_t address_length;
+};
+
+
+/**
+ * A HELLO message together with a sorted index of its addresses.
+ */
+struct GNUNET_HELLO_Parsed
+{
+  /**
+   * The serialized HELLO.
+   */
+  struct GNUNET_HELLO_Message *msg;
+
+  /**
+   * Addresses of @e msg, sorted by #parsed_address_cmp() and
+   * without duplicates.
+   */
+  struct ParsedAddress *addrs;
+
+  /**
+   * Number of entries in @e addrs.
+   */
+  unsigned int addrs_len;
 };
 
 
 /**
- * Store the expiration time of an address that matches the template.
+ * Compute the index key of an address.
  *
- * @param cls the `struct ExpireContext`
- * @param address address to match against the template
- * @param expiration expiration time of @a address, to store in @a cls
- * @return #GNUNET_SYSERR if we found a matching address, #GNUNET_OK otherwise
+ * @param transport_name name of the transport plugin
+ * @param address the address
+ * @param address_length number of bytes in @a address
+ * @return the key
+ */
+static uint32_t
+get_address_key (const char *transport_name,
+                 const void *address,
+                 uint16_t address_length)
+{
+  return ((uint32_t) GNUNET_CRYPTO_crc32_n (transport_name,
+                                            strlen (transport_name))) ^
+      ((uint32_t) GNUNET_CRYPTO_crc32_n (address, address_length));
+}
+
+
+/**
+ * Order two index entries by key, transport name and address.
+ * Entries comparing equal describe the same address (possibly
+ * with different expiration times).
+ *
+ * @param a1 first entry
+ * @param a2 second entry
+ * @return 0 if equal, negative if @a a1 sorts first, positive otherwise
  */
 static int
-get_match_exp (void *cls,
-               const struct GNUNET_HELLO_Address *address,
-               struct GNUNET_TIME_Absolute expiration)
+parsed_address_cmp (const struct ParsedAddress *a1,
+                    const struct ParsedAddress *a2)
 {
-  struct ExpireContext *ec = cls;
+  int ret;
 
-  if (0 == GNUNET_HELLO_address_cmp (address, ec->address))
+  if (a1->key != a2->key)
+    return (a1->key < a2->key) ? -1 : 1;
+  ret = strcmp (a1->transport_name, a2->transport_name);
+  if (0 != ret)
+    return ret;
+  if (a1->address_length != a2->address_length)
+    return (a1->address_length < a2->address_length) ? -1 : 1;
+  return memcmp (a1->address, a2->address, a1->address_length);
+}
+
+
+/**
+ * Wrapper around #parsed_address_cmp() for qsort().
+ *
+ * @param a1 first `struct ParsedAddress`
+ * @param a2 second `struct ParsedAddress`
+ * @return see #parsed_address_cmp()
+ */
+static int
+qsort_parsed_address_cmp (const void *a1,
+                          const void *a2)
+{
+  return parsed_address_cmp (a1, a2);
+}
+
+
+/**
+ * Build the sorted address index of a parsed HELLO.  Malformed
+ * trailing data is ignored (like #GNUNET_HELLO_iterate_addresses()
+ * does); duplicate addresses are indexed once with their latest
+ * expiration time.
+ *
+ * @param parsed parsed HELLO with @e msg set
+ */
+static void
+index_addresses (struct GNUNET_HELLO_Parsed *parsed)
+{
+  const char *inptr;
+  size_t insize;
+  size_t esize;
+  uint16_t alen;
+  unsigned int count;
+  unsigned int i;
+  unsigned int off;
+  int sorted;
+  struct GNUNET_TIME_AbsoluteNBO expire;
+  struct ParsedAddress *pa;
+
+  /* count the addresses first */
+  inptr = (const char *) &parsed->msg[1];
+  insize = ntohs (parsed->msg->header.size) - sizeof (struct GNUNET_HELLO_Message);
+  count = 0;
+  while (insize > 0)
   {
-    ec->found = GNUNET_YES;
-    ec->expiration = expiration;
-    return GNUNET_SYSERR;       /* done here */
+    esize = get_hello_address_size (inptr, insize, &alen);
+    if (0 == esize)
+      break;
+    count++;
+    insize -= esize;
+    inptr += esize;
   }
-  return GNUNET_OK;
+  parsed->addrs_len = 0;
+  parsed->addrs = (0 == count) ? NULL : GNUNET_new_array (count,
+                                                          struct ParsedAddress);
+  inptr = (const char *) &parsed->msg[1];
+  insize = ntohs (parsed->msg->header.size) - sizeof (struct GNUNET_HELLO_Message);
+  sorted = GNUNET_YES;
+  for (i = 0; i < count; i++)
+  {
+    esize = get_hello_address_size (inptr, insize, &alen);
+    pa = &parsed->addrs[i];
+    memcpy (&expire,
+            &inptr[esize - alen - sizeof (struct GNUNET_TIME_AbsoluteNBO)],
+            sizeof (struct GNUNET_TIME_AbsoluteNBO));
+    pa->transport_name = inptr;
+    pa->address = &inptr[esize - alen];
+    pa->address_length = alen;
+    pa->expiration = GNUNET_TIME_absolute_ntoh (expire);
+    pa->key = get_address_key (pa->transport_name, pa->address, alen);
+    if ((i > 0) && (parsed_address_cmp (&parsed->addrs[i - 1], pa) > 0))
+      sorted = GNUNET_NO;
+    insize -= esize;
+    inptr += esize;
+  }
+  if (GNUNET_NO == sorted)
+    qsort (parsed->addrs, count, sizeof (struct ParsedAddress),
+           &qsort_parsed_address_cmp);
+  /* drop duplicates, keeping the latest expiration */
+  off = 0;
+  for (i = 0; i < count; i++)
+  {
+    if ((off > 0) &&
+        (0 == parsed_address_cmp (&parsed->addrs[off - 1], &parsed->addrs[i])))
+    {
+      parsed->addrs[off - 1].expiration =
+          GNUNET_TIME_absolute_max (parsed->addrs[off - 1].expiration,
+                                    parsed->addrs[i].expiration);
+      continue;
+    }
+    parsed->addrs[off++] = parsed->addrs[i];
+  }
+  parsed->addrs_len = off;
 }
 
 
 /**
+ * Parse a HELLO message into a sorted index of its addresses.
  *
+ * @param msg HELLO to parse
+ * @return NULL if @a msg is not a HELLO
  */
-struct MergeContext
+struct GNUNET_HELLO_Parsed *
+GNUNET_HELLO_parse (const struct GNUNET_HELLO_Message *msg)
 {
-  /**
-   *
-   */
-  const struct GNUNET_HELLO_Message *h1;
+  struct GNUNET_HELLO_Parsed *parsed;
+  uint16_t msize;
 
-  /**
-   *
-   */
-  const struct GNUNET_HELLO_Message *h2;
+  msize = GNUNET_HELLO_size (msg);
+  if (0 == msize)
+    return NULL;
+  parsed = GNUNET_new (struct GNUNET_HELLO_Parsed);
+  parsed->msg = GNUNET_malloc (msize);
+  memcpy (parsed->msg, msg, msize);
+  index_addresses (parsed);
+  return parsed;
+}
 
-  /**
-   *
-   */
-  const struct GNUNET_HELLO_Message *other;
 
-  /**
-   *
-   */
-  char *buf;
+/**
+ * Free a parsed HELLO.
+ *
+ * @param parsed parsed HELLO to free
+ */
+void
+GNUNET_HELLO_parsed_destroy (struct GNUNET_HELLO_Parsed *parsed)
+{
+  GNUNET_free_non_null (parsed->addrs);
+  GNUNET_free_non_null (parsed->msg);
+  GNUNET_free (parsed);
+}
 
-  /**
-   *
-   */
-  size_t max;
 
-  /**
-   *
-   */
-  size_t ret;
+/**
+ * Get the serialized form of a parsed HELLO.
+ *
+ * @param parsed parsed HELLO
+ * @return the HELLO message, valid as long as @a parsed is
+ */
+const struct GNUNET_HELLO_Message *
+GNUNET_HELLO_parsed_get_message (const struct GNUNET_HELLO_Parsed *parsed)
+{
+  return parsed->msg;
+}
 
-  /**
-   *
-   */
-  int take_equal;
 
-};
+/**
+ * Fill in a `struct GNUNET_HELLO_Address` for an index entry.
+ *
+ * @param parsed parsed HELLO the entry belongs to
+ * @param pa the index entry
+ * @param[out] address set to the address of @a pa
+ */
+static void
+get_parsed_address (const struct GNUNET_HELLO_Parsed *parsed,
+                    const struct ParsedAddress *pa,
+                    struct GNUNET_HELLO_Address *address)
+{
+  address->peer.public_key = parsed->msg->publicKey;
+  address->transport_name = pa->transport_name;
+  address->address = pa->address;
+  address->address_length = pa->address_length;
+  address->local_info = GNUNET_HELLO_ADDRESS_INFO_NONE;
+}
 
 
 /**
+ * Iterate over the addresses of a parsed HELLO, in index order.
  *
+ * @param parsed parsed HELLO
+ * @param it iterator to call on each address, the return value
+ *        #GNUNET_SYSERR stops the iteration, others are ignored
+ * @param it_cls closure for @a it
+ */
+void
+GNUNET_HELLO_parsed_iterate (const struct GNUNET_HELLO_Parsed *parsed,
+                             GNUNET_HELLO_AddressIterator it,
+                             void *it_cls)
+{
+  struct GNUNET_HELLO_Address address;
+  unsigned int i;
+
+  for (i = 0; i < parsed->addrs_len; i++)
+  {
+    get_parsed_address (parsed, &parsed->addrs[i], &address);
+    if (GNUNET_SYSERR ==
+        it (it_cls, &address, parsed->addrs[i].expiration))
+      return;
+  }
+}
+
+
+/**
+ * Check if a parsed HELLO contains the given address.
  *
- * @param cls
- * @param address
- * @param expiration
- * @return
+ * @param parsed parsed HELLO
+ * @param address address to look for, the peer identity is ignored
+ * @param[out] expiration set to the expiration time of the
+ *             address if it was found, can be NULL
+ * @return #GNUNET_YES if @a address is in @a parsed, #GNUNET_NO if not
  */
-static int
-copy_latest (void *cls,
-             const struct GNUNET_HELLO_Address *address,
-             struct GNUNET_TIME_Absolute expiration)
+int
+GNUNET_HELLO_parsed_lookup (const struct GNUNET_HELLO_Parsed *parsed,
+                            const struct GNUNET_HELLO_Address *address,
+                            struct GNUNET_TIME_Absolute *expiration)
 {
-  struct MergeContext *mc = cls;
-  struct ExpireContext ec;
-
-  ec.address = address;
-  ec.found = GNUNET_NO;
-  GNUNET_HELLO_iterate_addresses (mc->other, GNUNET_NO, &get_match_exp, &ec);
-  if ((ec.found == GNUNET_NO) ||
-      (ec.expiration.abs_value_us < expiration.abs_value_us) ||
-      ((ec.expiration.abs_value_us == expiration.abs_value_us) &&
-       (mc->take_equal == GNUNET_YES)))
+  struct ParsedAddress needle;
+  unsigned int lo;
+  unsigned int hi;
+  unsigned int mid;
+  int cmp;
+
+  if (GNUNET_HELLO_ADDRESS_INFO_NONE != address->local_info)
+    return GNUNET_NO;
+  needle.transport_name = address->transport_name;
+  needle.address = address->address;
+  needle.address_length = address->address_length;
+  needle.key = get_address_key (address->transport_name,
+                                address->address,
+                                address->address_length);
+  lo = 0;
+  hi = parsed->addrs_len;
+  while (lo < hi)
   {
-    mc->ret +=
-        GNUNET_HELLO_add_address (address, expiration, &mc->buf[mc->ret],
-                                  mc->max - mc->ret);
+    mid = lo + (hi - lo) / 2;
+    cmp = parsed_address_cmp (&needle, &parsed->addrs[mid]);
+    if (0 == cmp)
+    {
+      if (NULL != expiration)
+        *expiration = parsed->addrs[mid].expiration;
+      return GNUNET_YES;
+    }
+    if (cmp < 0)
+      hi = mid;
+    else
+      lo = mid + 1;
   }
-  return GNUNET_OK;
+  return GNUNET_NO;
 }
 
 
 /**
+ * Merge the addresses of two parsed HELLOs (which must be for the
+ * same peer) in one pass over both indices.  Addresses present in
+ * both HELLOs are kept with the later expiration time.
  *
+ * @param p1 first parsed HELLO
+ * @param p2 second parsed HELLO
+ * @return the combined HELLO, already parsed
  */
-static ssize_t
-merge_addr (void *cls,
-            size_t max,
-            void *buf)
+struct GNUNET_HELLO_Parsed *
+GNUNET_HELLO_parsed_merge (const struct GNUNET_HELLO_Parsed *p1,
+                           const struct GNUNET_HELLO_Parsed *p2)
 {
-  struct MergeContext *mc = cls;
-
-  if (mc->h1 == NULL)
-    return GNUNET_SYSERR; /* Stop iteration */
-  mc->ret = 0;
-  mc->max = max;
-  mc->buf = buf;
-  mc->take_equal = GNUNET_NO;
-  mc->other = mc->h2;
-  GNUNET_HELLO_iterate_addresses (mc->h1, GNUNET_NO, &copy_latest, mc);
-  mc->take_equal = GNUNET_YES;
-  mc->other = mc->h1;
-  GNUNET_HELLO_iterate_addresses (mc->h2, GNUNET_NO, &copy_latest, mc);
-  mc->h1 = NULL;
-  return mc->ret;
+  char buf[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1 - 256 -
+           sizeof (struct GNUNET_HELLO_Message)];
+  struct GNUNET_HELLO_Parsed *parsed;
+  struct GNUNET_HELLO_Address address;
+  const struct GNUNET_HELLO_Parsed *src;
+  const struct ParsedAddress *pa;
+  size_t max;
+  size_t used;
+  size_t ret;
+  unsigned int i;
+  unsigned int j;
+  int cmp;
+  int friend_only;
+
+  if (p1->msg->friend_only != p2->msg->friend_only)
+    friend_only = GNUNET_YES; /* One of the HELLOs is friend only */
+  else
+    friend_only = ntohl (p1->msg->friend_only); /* Both HELLO's have the same type */
+  max = sizeof (buf);
+  used = 0;
+  i = 0;
+  j = 0;
+  while ((i < p1->addrs_len) || (j < p2->addrs_len))
+  {
+    if (j == p2->addrs_len)
+      cmp = -1;
+    else if (i == p1->addrs_len)
+      cmp = 1;
+    else
+      cmp = parsed_address_cmp (&p1->addrs[i], &p2->addrs[j]);
+    if ( (cmp < 0) ||
+         ( (0 == cmp) &&
+           (p1->addrs[i].expiration.abs_value_us >
+            p2->addrs[j].expiration.abs_value_us) ) )
+    {
+      src = p1;
+      pa = &p1->addrs[i];
+    }
+    else
+    {
+      src = p2;
+      pa = &p2->addrs[j];
+    }
+    if (cmp <= 0)
+      i++;
+    if (cmp >= 0)
+      j++;
+    get_parsed_address (src, pa, &address);
+    ret = GNUNET_HELLO_add_address (&address, pa->expiration,
+                                    &buf[used], max - used);
+    used += ret;
+  }
+  parsed = GNUNET_new (struct GNUNET_HELLO_Parsed);
+  parsed->msg = GNUNET_malloc (sizeof (struct GNUNET_HELLO_Message) + used);
+  memcpy (&parsed->msg[1], buf, used);
+  parsed->msg->header.type = htons (GNUNET_MESSAGE_TYPE_HELLO);
+  parsed->msg->header.size = htons (sizeof (struct GNUNET_HELLO_Message) + used);
+  parsed->msg->friend_only = htonl (friend_only);
+  parsed->msg->publicKey = p1->msg->publicKey;
+  /* the addresses were written in index order, no sorting needed */
+  index_addresses (parsed);
+  return parsed;
+}
+
+
+/**
+ * Test if two parsed HELLOs contain the same addresses, in one
+ * pass over both indices.  See #GNUNET_HELLO_equals().
+ *
+ * @param p1 first parsed HELLO
+ * @param p2 second parsed HELLO
+ * @param now time to use for deciding which addresses have
+ *            expired and should not be considered at all
+ * @return absolute time forever if the two HELLOs are
+ *         totally identical; smallest timestamp >= now if
+ *         they only differ in timestamps;
+ *         zero if the some addresses with expirations >= now
+ *         do not match at all
+ */
+struct GNUNET_TIME_Absolute
+GNUNET_HELLO_parsed_equals (const struct GNUNET_HELLO_Parsed *p1,
+                            const struct GNUNET_HELLO_Parsed *p2,
+                            struct GNUNET_TIME_Absolute now)
+{
+  struct GNUNET_TIME_Absolute result;
+  unsigned int i;
+  unsigned int j;
+
+  if (0 !=
+      memcmp (&p1->msg->publicKey, &p2->msg->publicKey,
+              sizeof (struct GNUNET_CRYPTO_EddsaPublicKey)))
+    return GNUNET_TIME_UNIT_ZERO_ABS;
+  result = GNUNET_TIME_UNIT_FOREVER_ABS;
+  i = 0;
+  j = 0;
+  while (1)
+  {
+    while ((i < p1->addrs_len) &&
+           (p1->addrs[i].expiration.abs_value_us < now.abs_value_us))
+      i++;
+    while ((j < p2->addrs_len) &&
+           (p2->addrs[j].expiration.abs_value_us < now.abs_value_us))
+      j++;
+    if ((i == p1->addrs_len) && (j == p2->addrs_len))
+      break;
+    if ((i == p1->addrs_len) || (j == p2->addrs_len) ||
+        (0 != parsed_address_cmp (&p1->addrs[i], &p2->addrs[j])))
+      return GNUNET_TIME_UNIT_ZERO_ABS;
+    if (p1->addrs[i].expiration.abs_value_us !=
+        p2->addrs[j].expiration.abs_value_us)
+      result = GNUNET_TIME_absolute_min (result,
+                                         GNUNET_TIME_absolute_min (p1->addrs[i].expiration,
+                                                                   p2->addrs[j].expiration));
+    i++;
+    j++;
+  }
+  return result;
 }
 
 
@@ -510,33 +837,46 @@ struct GNUNET_HELLO_Message *
 GNUNET_HELLO_merge (const struct GNUNET_HELLO_Message *h1,
                     const struct GNUNET_HELLO_Message *h2)
 {
-  struct MergeContext mc = { h1, h2, NULL, NULL, 0, 0, 0 };
-  int friend_only;
-
-  if (h1->friend_only != h2->friend_only)
-    friend_only = GNUNET_YES; /* One of the HELLOs is friend only */
-  else
-    friend_only = ntohl (h1->friend_only); /* Both HELLO's have the same type */
+  struct GNUNET_HELLO_Parsed *p1;
+  struct GNUNET_HELLO_Parsed *p2;
+  struct GNUNET_HELLO_Parsed *pm;
+  struct GNUNET_HELLO_Message *ret;
 
-  return GNUNET_HELLO_create (&h1->publicKey,
-                              &merge_addr,
-                              &mc,
-                              friend_only);
+  p1 = GNUNET_HELLO_parse (h1);
+  p2 = GNUNET_HELLO_parse (h2);
+  if ((NULL == p1) || (NULL == p2))
+  {
+    GNUNET_break (0);
+    if (NULL != p1)
+      GNUNET_HELLO_parsed_destroy (p1);
+    if (NULL != p2)
+      GNUNET_HELLO_parsed_destroy (p2);
+    return GNUNET_HELLO_create (&h1->publicKey, NULL, NULL,
+                                (h1->friend_only != h2->friend_only)
+                                ? GNUNET_YES : ntohl (h1->friend_only));
+  }
+  pm = GNUNET_HELLO_parsed_merge (p1, p2);
+  ret = pm->msg;
+  pm->msg = NULL;
+  GNUNET_HELLO_parsed_destroy (pm);
+  GNUNET_HELLO_parsed_destroy (p1);
+  GNUNET_HELLO_parsed_destroy (p2);
+  return ret;
 }
 
 
 /**
- *
+ * Closure for #delta_match().
  */
 struct DeltaContext
 {
   /**
-   *
+   * Ignore addresses in @e old_hello that expired before this time.
    */
   struct GNUNET_TIME_Absolute expiration_limit;
 
   /**
-   *
+   * Function to call on each new address.
    */
   GNUNET_HELLO_AddressIterator it;
 
@@ -546,14 +886,20 @@ struct DeltaContext
   void *it_cls;
 
   /**
-   *
+   * The old HELLO, parsed.
    */
-  const struct GNUNET_HELLO_Message *old_hello;
+  const struct GNUNET_HELLO_Parsed *old_hello;
 };
 
 
 /**
+ * Call the iterator of the `struct DeltaContext` on an address
+ * of the new HELLO unless the old HELLO has it already.
  *
+ * @param cls the `struct DeltaContext`
+ * @param address address of the new HELLO
+ * @param expiration expiration time of @a address
+ * @return result of the iterator, #GNUNET_YES for skipped addresses
  */
 static int
 delta_match (void *cls,
@@ -561,21 +907,14 @@ delta_match (void *cls,
              struct GNUNET_TIME_Absolute expiration)
 {
   struct DeltaContext *dc = cls;
-  int ret;
-  struct ExpireContext ec;
+  struct GNUNET_TIME_Absolute old_expiration;
 
-  ec.address = address;
-  ec.found = GNUNET_NO;
-  GNUNET_HELLO_iterate_addresses (dc->old_hello,
-                                  GNUNET_NO,
-                                  &get_match_exp,
-                                  &ec);
-  if ((ec.found == GNUNET_YES) &&
-      ((ec.expiration.abs_value_us > expiration.abs_value_us) ||
-       (ec.expiration.abs_value_us >= dc->expiration_limit.abs_value_us)))
+  if ((GNUNET_YES ==
+       GNUNET_HELLO_parsed_lookup (dc->old_hello, address, &old_expiration)) &&
+      ((old_expiration.abs_value_us > expiration.abs_value_us) ||
+       (old_expiration.abs_value_us >= dc->expiration_limit.abs_value_us)))
     return GNUNET_YES;          /* skip */
-  ret = dc->it (dc->it_cls, address, expiration);
-  return ret;
+  return dc->it (dc->it_cls, address, expiration);
 }
 
 
@@ -598,12 +937,21 @@ GNUNET_HELLO_iterate_new_addresses (const struct GNUNET_HELLO_Message *new_hello
                                     void *it_cls)
 {
   struct DeltaContext dc;
+  struct GNUNET_HELLO_Parsed *parsed;
 
+  parsed = GNUNET_HELLO_parse (old_hello);
+  if (NULL == parsed)
+  {
+    /* nothing is known about the old HELLO, all addresses are new */
+    GNUNET_HELLO_iterate_addresses (new_hello, GNUNET_NO, it, it_cls);
+    return;
+  }
   dc.expiration_limit = expiration_limit;
   dc.it = it;
   dc.it_cls = it_cls;
-  dc.old_hello = old_hello;
+  dc.old_hello = parsed;
   GNUNET_HELLO_iterate_addresses (new_hello, GNUNET_NO, &delta_match, &dc);
+  GNUNET_HELLO_parsed_destroy (parsed);
 }
 
 
@@ -687,92 +1035,6 @@ GNUNET_HELLO_get_header (struct GNUNET_HELLO_Message *hello)
 }
 
 
-/**
- *
- */
-struct EqualsContext
-{
-  /**
-   *
-   */
-  struct GNUNET_TIME_Absolute expiration_limit;
-
-  /**
-   *
-   */
-  struct GNUNET_TIME_Absolute result;
-
-  /**
-   *
-   */
-  const struct GNUNET_HELLO_Message *h2;
-
-  /**
-   *
-   */
-  const struct GNUNET_HELLO_Address *address;
-
-  /**
-   *
-   */
-  struct GNUNET_TIME_Absolute expiration;
-
-  /**
-   *
-   */
-  int found;
-
-};
-
-
-/**
- *
- */
-static int
-find_other_matching (void *cls,
-                     const struct GNUNET_HELLO_Address *address,
-                     struct GNUNET_TIME_Absolute expiration)
-{
-  struct EqualsContext *ec = cls;
-
-  if (expiration.abs_value_us < ec->expiration_limit.abs_value_us)
-    return GNUNET_YES;
-  if (0 == GNUNET_HELLO_address_cmp (address, ec->address))
-  {
-    ec->found = GNUNET_YES;
-    if (expiration.abs_value_us < ec->expiration.abs_value_us)
-      ec->result = GNUNET_TIME_absolute_min (expiration, ec->result);
-    return GNUNET_SYSERR;
-  }
-  return GNUNET_YES;
-}
-
-
-/**
- *
- */
-static int
-find_matching (void *cls,
-               const struct GNUNET_HELLO_Address *address,
-               struct GNUNET_TIME_Absolute expiration)
-{
-  struct EqualsContext *ec = cls;
-
-  if (expiration.abs_value_us < ec->expiration_limit.abs_value_us)
-    return GNUNET_YES;
-  ec->address = address;
-  ec->expiration = expiration;
-  ec->found = GNUNET_NO;
-  GNUNET_HELLO_iterate_addresses (ec->h2, GNUNET_NO, &find_other_matching, ec);
-  if (ec->found == GNUNET_NO)
-  {
-    ec->result = GNUNET_TIME_UNIT_ZERO_ABS;
-    return GNUNET_SYSERR;
-  }
-  return GNUNET_OK;
-}
-
-
 /**
  * Test if two HELLO messages contain the same addresses.
  * If they only differ in expiration time, the lowest
@@ -794,7 +1056,9 @@ GNUNET_HELLO_equals (const struct GNUNET_HELLO_Message *h1,
                      const struct GNUNET_HELLO_Message *h2,
                      struct GNUNET_TIME_Absolute now)
 {
-  struct EqualsContext ec;
+  struct GNUNET_HELLO_Parsed *p1;
+  struct GNUNET_HELLO_Parsed *p2;
+  struct GNUNET_TIME_Absolute ret;
 
   if (h1->header.type != h2->header.type)
   	return GNUNET_TIME_UNIT_ZERO_ABS;
@@ -803,21 +1067,17 @@ GNUNET_HELLO_equals (const struct GNUNET_HELLO_Message *h1,
       memcmp (&h1->publicKey, &h2->publicKey,
               sizeof (struct GNUNET_CRYPTO_EddsaPublicKey)))
     return GNUNET_TIME_UNIT_ZERO_ABS;
-  ec.expiration_limit = now;
-  ec.result = GNUNET_TIME_UNIT_FOREVER_ABS;
-  ec.h2 = h2;
-  GNUNET_HELLO_iterate_addresses (h1,
-                                  GNUNET_NO,
-                                  &find_matching,
-                                  &ec);
-  if (ec.result.abs_value_us == GNUNET_TIME_UNIT_ZERO.rel_value_us)
-    return ec.result;
-  ec.h2 = h1;
-  GNUNET_HELLO_iterate_addresses (h2,
-                                  GNUNET_NO,
-                                  &find_matching,
-                                  &ec);
-  return ec.result;
+  p1 = GNUNET_HELLO_parse (h1);
+  p2 = GNUNET_HELLO_parse (h2);
+  if ((NULL == p1) || (NULL == p2))
+    ret = GNUNET_TIME_UNIT_ZERO_ABS;
+  else
+    ret = GNUNET_HELLO_parsed_equals (p1, p2, now);
+  if (NULL != p1)
+    GNUNET_HELLO_parsed_destroy (p1);
+  if (NULL != p2)
+    GNUNET_HELLO_parsed_destroy (p2);
+  return ret;
 }
 
 
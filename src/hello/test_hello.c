@@ -93,6 +93,11 @@ main (int argc, char *argv[])
   struct GNUNET_HELLO_Message *msg1;
   struct GNUNET_HELLO_Message *msg2;
   struct GNUNET_HELLO_Message *msg3;
+  struct GNUNET_HELLO_Parsed *p2;
+  struct GNUNET_HELLO_Parsed *p3;
+  struct GNUNET_HELLO_Parsed *pm;
+  struct GNUNET_HELLO_Address address;
+  struct GNUNET_TIME_Absolute expiration;
   struct GNUNET_CRYPTO_EddsaPublicKey publicKey;
   struct GNUNET_CRYPTO_EddsaPublicKey pk;
   struct GNUNET_TIME_Absolute startup_time;
@@ -180,6 +185,39 @@ main (int argc, char *argv[])
   GNUNET_HELLO_iterate_new_addresses (msg3, msg2, startup_time, &check_addr,
                                       &i);
   GNUNET_assert (i == 0);
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	   "Testing parsed HELLOs...\n");
+  p2 = GNUNET_HELLO_parse (msg2);
+  p3 = GNUNET_HELLO_parse (msg3);
+  GNUNET_assert ((NULL != p2) && (NULL != p3));
+  i = 3;
+  GNUNET_HELLO_parsed_iterate (p3, &check_addr, &i);
+  GNUNET_assert (i == 0);
+  memset (&address, 0, sizeof (address));
+  address.transport_name = "test";
+  address.address = "address_information";
+  address.address_length = 2;
+  GNUNET_assert (GNUNET_NO ==
+                 GNUNET_HELLO_parsed_lookup (p2, &address, NULL));
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_HELLO_parsed_lookup (p3, &address, &expiration));
+  GNUNET_assert (expiration.abs_value_us >= startup_time.abs_value_us);
+  GNUNET_assert (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us ==
+                 GNUNET_HELLO_parsed_equals (p3, p3, startup_time).abs_value_us);
+  GNUNET_assert (0 ==
+                 GNUNET_HELLO_parsed_equals (p2, p3, startup_time).abs_value_us);
+  pm = GNUNET_HELLO_parsed_merge (p2, p3);
+  GNUNET_assert (GNUNET_HELLO_size (GNUNET_HELLO_parsed_get_message (pm)) ==
+                 GNUNET_HELLO_size (msg3));
+  GNUNET_assert (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us ==
+                 GNUNET_HELLO_parsed_equals (pm, p3, startup_time).abs_value_us);
+  GNUNET_assert (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us ==
+                 GNUNET_HELLO_equals (GNUNET_HELLO_parsed_get_message (pm),
+                                      msg3, startup_time).abs_value_us);
+  GNUNET_HELLO_parsed_destroy (pm);
+  GNUNET_HELLO_parsed_destroy (p2);
+  GNUNET_HELLO_parsed_destroy (p3);
   GNUNET_free (msg2);
   GNUNET_free (msg3);
   return 0;                     /* testcase passed */
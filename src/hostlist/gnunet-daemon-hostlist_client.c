@@ -87,6 +87,26 @@
  */
 #define HOSTLIST_SUCCESSFUL_HELLO 1
 
+/**
+ * Default number of hostlist servers we download from in parallel
+ */
+#define DEFAULT_PARALLEL_DOWNLOADS 3
+
+/**
+ * Maximum number of downloaded HELLOs waiting to be handed to transport
+ */
+#define MAX_PENDING_HELLOS 1024
+
+/**
+ * Number of HELLOs handed to transport at once
+ */
+#define HELLO_OFFER_BATCH 16
+
+/**
+ * Time interval between handing two batches of HELLOs to transport
+ */
+#define HELLO_OFFER_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 50)
+
 
 
 /**
@@ -139,6 +159,100 @@ struct Hostlist
    */
   uint32_t times_used;
 
+  /**
+   * Download from this hostlist that is currently running, NULL for none
+   */
+  struct Download *download;
+
+};
+
+
+/**
+ * A download from a single hostlist server.  All downloads of a
+ * download round share the same multi-CURL handle.
+ */
+struct Download
+{
+  /**
+   * This is a doubly-linked list.
+   */
+  struct Download *prev;
+
+  /**
+   * This is a doubly-linked list.
+   */
+  struct Download *next;
+
+  /**
+   * CURL handle of this download.
+   */
+  CURL *curl;
+
+  /**
+   * URL we are downloading from.
+   */
+  char *url;
+
+  /**
+   * Learned hostlist we are downloading from, NULL for a
+   * preconfigured bootstrap server.
+   */
+  struct Hostlist *hostlist;
+
+  /**
+   * Buffer for a HELLO that spans two chunks of downloaded data.
+   */
+  char *buffer;
+
+  /**
+   * Number of bytes valid in @e buffer.
+   */
+  size_t pos;
+
+  /**
+   * How many bytes did we download from this URL?
+   */
+  uint32_t bytes;
+
+  /**
+   * How many valid HELLO messages did we obtain from this URL?
+   */
+  unsigned int hellos;
+
+  /**
+   * Set to #GNUNET_YES if the URL had some problems.
+   */
+  int bogus;
+
+  /**
+   * Set to #GNUNET_YES if the download completed.
+   */
+  int successful;
+
+  /**
+   * #GNUNET_YES if this download tests an advertised hostlist.
+   */
+  int testing;
+
+};
+
+
+/**
+ * A downloaded HELLO waiting to be handed to transport.
+ */
+struct PendingHello
+{
+  /**
+   * This is a doubly-linked list.
+   */
+  struct PendingHello *prev;
+
+  /**
+   * This is a doubly-linked list.
+   */
+  struct PendingHello *next;
+
+  /* followed by the HELLO */
 };
 
 
@@ -178,29 +292,56 @@ static char *proxy_password;
 static curl_proxytype proxy_type;
 
 /**
- * Number of bytes valid in 'download_buffer'.
+ * Current multi-CURL handle.
  */
-static size_t download_pos;
+static CURLM *multi;
 
 /**
- * Current URL that we are using.
+ * Head of the list of running downloads.
  */
-static char *current_url;
+static struct Download *download_head;
 
 /**
- * Current CURL handle.
+ * Tail of the list of running downloads.
  */
-static CURL *curl;
+static struct Download *download_tail;
 
 /**
- * Current multi-CURL handle.
+ * Number of entries in the list of running downloads.
  */
-static CURLM *multi;
+static unsigned int download_count;
+
+/**
+ * Maximum number of hostlist servers we download from in parallel.
+ */
+static unsigned int parallel_downloads;
+
+/**
+ * Hashes of the HELLOs obtained during the current download round,
+ * so that we hand each HELLO to transport only once even if several
+ * servers list it.  Values are NULL.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *known_hellos;
+
+/**
+ * Head of the queue of HELLOs to hand to transport.
+ */
+static struct PendingHello *pending_head;
+
+/**
+ * Tail of the queue of HELLOs to hand to transport.
+ */
+static struct PendingHello *pending_tail;
 
 /**
- * How many bytes did we download from the current hostlist URL?
+ * Number of entries in the queue of HELLOs to hand to transport.
  */
-static uint32_t stat_bytes_downloaded;
+static unsigned int pending_count;
+
+/**
+ * ID of the task handing queued HELLOs to transport
+ */
+static struct GNUNET_SCHEDULER_Task * ti_offer_hellos;
 
 /**
  * Amount of time we wait between hostlist downloads.
@@ -247,11 +388,6 @@ static struct Hostlist *linked_list_head;
  */
 static struct Hostlist *linked_list_tail;
 
-/**
- *  Current hostlist used for downloading
- */
-static struct Hostlist *current_hostlist;
-
 /**
  *  Size of the linke list  used to store hostlists
  */
@@ -267,11 +403,6 @@ static struct Hostlist *hostlist_to_test;
  */
 static struct GNUNET_STATISTICS_GetHandle *sget;
 
-/**
- * Set to GNUNET_YES if the current URL had some problems.
- */
-static int stat_bogus_url;
-
 /**
  * Value controlling if a hostlist is tested at the moment
  */
@@ -288,7 +419,8 @@ static int stat_testing_allowed;
 static int stat_download_in_progress;
 
 /**
- * Value saying if a preconfigured bootstrap server is used
+ * Value saying if preconfigured bootstrap servers get the larger
+ * share of the next download round
  */
 static unsigned int stat_use_bootstrap;
 
@@ -298,29 +430,116 @@ static unsigned int stat_use_bootstrap;
 static int stat_learning;
 
 /**
- * Value saying if hostlist download was successful
+ * Number of active connections (according to core service).
  */
-static unsigned int stat_download_successful;
+static unsigned int stat_connection_count;
+
 
 /**
- * Value saying how many valid HELLO messages were obtained during download
+ * Hand a batch of queued HELLOs to transport; reschedules itself
+ * until the queue is empty so that a large hostlist does not flood
+ * transport (and peerinfo) with thousands of HELLOs at once.
+ *
+ * @param cls closure, unused
+ * @param tc task context, unused
  */
-static unsigned int stat_hellos_obtained;
+static void
+task_offer_hellos (void *cls,
+                   const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct PendingHello *ph;
+  unsigned int i;
+
+  ti_offer_hellos = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  for (i = 0; (i < HELLO_OFFER_BATCH) && (NULL != (ph = pending_head)); i++)
+  {
+    GNUNET_CONTAINER_DLL_remove (pending_head, pending_tail, ph);
+    pending_count--;
+    GNUNET_TRANSPORT_offer_hello (transport,
+                                  (const struct GNUNET_MessageHeader *) &ph[1],
+                                  NULL, NULL);
+    GNUNET_free (ph);
+  }
+  if (NULL != pending_head)
+    ti_offer_hellos =
+        GNUNET_SCHEDULER_add_delayed (HELLO_OFFER_FREQUENCY,
+                                      &task_offer_hellos, NULL);
+}
+
 
 /**
- * Number of active connections (according to core service).
+ * Check a HELLO received from a hostlist server and, unless we
+ * already got the same HELLO from another server during this
+ * round, queue it for transport.
+ *
+ * @param dl download the HELLO was received from
+ * @param msg the HELLO
+ * @param msize size of @a msg
+ * @return #GNUNET_OK if the HELLO was well-formed,
+ *         #GNUNET_SYSERR if the server sent garbage
  */
-static unsigned int stat_connection_count;
+static int
+process_hello (struct Download *dl,
+               const struct GNUNET_MessageHeader *msg,
+               uint16_t msize)
+{
+  struct GNUNET_HashCode hc;
+  struct PendingHello *ph;
+
+  if (GNUNET_HELLO_size ((const struct GNUNET_HELLO_Message *) msg) != msize)
+    return GNUNET_SYSERR;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Received valid `%s' message from hostlist server.\n",
+              "HELLO");
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop
+                            ("# valid HELLOs downloaded from hostlist servers"),
+                            1, GNUNET_NO);
+  dl->hellos++;
+  GNUNET_CRYPTO_hash (msg, msize, &hc);
+  if (GNUNET_YES ==
+      GNUNET_CONTAINER_multihashmap_contains (known_hellos, &hc))
+  {
+    GNUNET_STATISTICS_update (stats,
+                              gettext_noop
+                              ("# duplicate HELLOs downloaded from hostlist servers"),
+                              1, GNUNET_NO);
+    return GNUNET_OK;
+  }
+  if (pending_count >= MAX_PENDING_HELLOS)
+  {
+    GNUNET_STATISTICS_update (stats,
+                              gettext_noop
+                              ("# HELLOs from hostlist servers dropped (queue full)"),
+                              1, GNUNET_NO);
+    return GNUNET_OK;
+  }
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_CONTAINER_multihashmap_put (known_hellos, &hc, NULL,
+                                                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  ph = GNUNET_malloc (sizeof (struct PendingHello) + msize);
+  memcpy (&ph[1], msg, msize);
+  GNUNET_CONTAINER_DLL_insert_tail (pending_head, pending_tail, ph);
+  pending_count++;
+  if (NULL == ti_offer_hellos)
+    ti_offer_hellos = GNUNET_SCHEDULER_add_now (&task_offer_hellos, NULL);
+  return GNUNET_OK;
+}
 
 
 /**
- * Process downloaded bits by calling callback on each HELLO.
+ * Process downloaded bits by calling #process_hello() on each HELLO.
+ * Complete HELLOs are parsed directly from CURL's buffer; only a
+ * HELLO that spans two chunks is copied into the download's buffer.
  *
  * @param ptr buffer with downloaded data
  * @param size size of a record
  * @param nmemb number of records downloaded
- * @param ctx unused
- * @return number of bytes that were processed (always size*nmemb)
+ * @param ctx the `struct Download`
+ * @return number of bytes that were processed (size*nmemb),
+ *         0 to abort the download
  */
 static size_t
 callback_download (void *ptr,
@@ -328,7 +547,7 @@ callback_download (void *ptr,
                    size_t nmemb,
                    void *ctx)
 {
-  static char download_buffer[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1];
+  struct Download *dl = ctx;
   const char *cbuf = ptr;
   const struct GNUNET_MessageHeader *msg;
   size_t total;
@@ -337,8 +556,15 @@ callback_download (void *ptr,
   uint16_t msize;
 
   total = size * nmemb;
-  stat_bytes_downloaded += total;
-  if ((total == 0) || (stat_bogus_url))
+  dl->bytes += total;
+  if (dl->bytes > MAX_BYTES_PER_HOSTLISTS)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Download limit of %u bytes exceeded, stopping download\n"),
+                MAX_BYTES_PER_HOSTLISTS);
+    return 0;
+  }
+  if ((total == 0) || (GNUNET_YES == dl->bogus))
   {
     return total;               /* ok, no data or bogus data */
   }
@@ -348,181 +574,64 @@ callback_download (void *ptr,
                             ("# bytes downloaded from hostlist servers"),
                             (int64_t) total, GNUNET_NO);
   left = total;
-  while ((left > 0) || (download_pos > 0))
+  /* first complete the HELLO left over from the previous chunk */
+  while ((dl->pos > 0) && (left > 0))
   {
-    cpy = GNUNET_MIN (left, GNUNET_SERVER_MAX_MESSAGE_SIZE - 1 - download_pos);
-    memcpy (&download_buffer[download_pos], cbuf, cpy);
-    cbuf += cpy;
-    download_pos += cpy;
-    left -= cpy;
-    if (download_pos < sizeof (struct GNUNET_MessageHeader))
+    if (dl->pos < sizeof (struct GNUNET_MessageHeader))
     {
-      GNUNET_assert (0 == left);
-      break;
+      cpy = GNUNET_MIN (left, sizeof (struct GNUNET_MessageHeader) - dl->pos);
+      memcpy (&dl->buffer[dl->pos], cbuf, cpy);
+      cbuf += cpy;
+      dl->pos += cpy;
+      left -= cpy;
+      continue;
     }
-    msg = (const struct GNUNET_MessageHeader *) download_buffer;
+    msg = (const struct GNUNET_MessageHeader *) dl->buffer;
     msize = ntohs (msg->size);
     if (msize < sizeof (struct GNUNET_MessageHeader))
+      goto bogus;
+    cpy = GNUNET_MIN (left, msize - dl->pos);
+    memcpy (&dl->buffer[dl->pos], cbuf, cpy);
+    cbuf += cpy;
+    dl->pos += cpy;
+    left -= cpy;
+    if (dl->pos < msize)
     {
-      GNUNET_STATISTICS_update (stats,
-                                gettext_noop
-                                ("# invalid HELLOs downloaded from hostlist servers"),
-                                1, GNUNET_NO);
-      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                  _("Invalid `%s' message received from hostlist at `%s'\n"),
-                  "HELLO", current_url);
-      stat_hellos_obtained++;
-      stat_bogus_url = 1;
-      return total;
-    }
-    if (download_pos < msize)
-    {
-      GNUNET_assert (left == 0);
-      break;
-    }
-    if (GNUNET_HELLO_size ((const struct GNUNET_HELLO_Message *) msg) == msize)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                  "Received valid `%s' message from hostlist server.\n",
-                  "HELLO");
-      GNUNET_STATISTICS_update (stats,
-                                gettext_noop
-                                ("# valid HELLOs downloaded from hostlist servers"),
-                                1, GNUNET_NO);
-      stat_hellos_obtained++;
-      GNUNET_TRANSPORT_offer_hello (transport, msg, NULL, NULL);
-    }
-    else
-    {
-      GNUNET_STATISTICS_update (stats,
-                                gettext_noop
-                                ("# invalid HELLOs downloaded from hostlist servers"),
-                                1, GNUNET_NO);
-      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                  _("Invalid `%s' message received from hostlist at `%s'\n"),
-                  "HELLO", current_url);
-      stat_bogus_url = GNUNET_YES;
-      stat_hellos_obtained++;
+      GNUNET_assert (0 == left);
       return total;
     }
-    memmove (download_buffer, &download_buffer[msize], download_pos - msize);
-    download_pos -= msize;
-  }
-  return total;
-}
-
-
-/**
- * Obtain a hostlist URL that we should use.
- *
- * @return NULL if there is no URL available
- */
-static char *
-get_bootstrap_server ()
-{
-  char *servers;
-  char *ret;
-  size_t urls;
-  size_t pos;
-
-  if (GNUNET_OK !=
-      GNUNET_CONFIGURATION_get_value_string (cfg, "HOSTLIST", "SERVERS",
-                                             &servers))
-  {
-    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_WARNING,
-			       "hostlist", "SERVERS");
-    return NULL;
-  }
-
-  urls = 0;
-  if (strlen (servers) > 0)
-  {
-    urls++;
-    pos = strlen (servers) - 1;
-    while (pos > 0)
-    {
-      if (servers[pos] == ' ')
-        urls++;
-      pos--;
-    }
+    if (GNUNET_OK != process_hello (dl, msg, msize))
+      goto bogus;
+    dl->pos = 0;
   }
-  if (urls == 0)
+  /* then parse all complete HELLOs in place */
+  while (left >= sizeof (struct GNUNET_MessageHeader))
   {
-    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_WARNING,
-			       "hostlist", "SERVERS");
-    GNUNET_free (servers);
-    return NULL;
-  }
-
-  urls = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, urls) + 1;
-  pos = strlen (servers) - 1;
-  while (pos > 0)
-  {
-    if (servers[pos] == ' ')
-    {
-      urls--;
-      servers[pos] = '\0';
-    }
-    if (urls == 0)
-    {
-      pos++;
+    msg = (const struct GNUNET_MessageHeader *) cbuf;
+    msize = ntohs (msg->size);
+    if (msize < sizeof (struct GNUNET_MessageHeader))
+      goto bogus;
+    if (msize > left)
       break;
-    }
-    pos--;
-  }
-  ret = GNUNET_strdup (&servers[pos]);
-  GNUNET_free (servers);
-  return ret;
-}
-
-
-/**
- * Method deciding if a preconfigured or advertisied hostlist is used on a 50:50 ratio
- * @return uri to use, NULL if there is no URL available
- */
-static char *
-download_get_url ()
-{
-  uint32_t index;
-  unsigned int counter;
-  struct Hostlist *pos;
-
-  if (GNUNET_NO == stat_learning)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Using preconfigured bootstrap server\n");
-    current_hostlist = NULL;
-    return get_bootstrap_server ();
-  }
-
-  if ((GNUNET_YES == stat_testing_hostlist) && (NULL != hostlist_to_test))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Testing new advertised hostlist if it is obtainable\n");
-    current_hostlist = hostlist_to_test;
-    return GNUNET_strdup (hostlist_to_test->hostlist_uri);
-  }
-
-  if ((GNUNET_YES == stat_use_bootstrap) || (linked_list_size == 0))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Using preconfigured bootstrap server\n");
-    current_hostlist = NULL;
-    return get_bootstrap_server ();
+    if (GNUNET_OK != process_hello (dl, msg, msize))
+      goto bogus;
+    cbuf += msize;
+    left -= msize;
   }
-  index =
-      GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, linked_list_size);
-  counter = 0;
-  pos = linked_list_head;
-  while (counter < index)
-  {
-    pos = pos->next;
-    counter++;
-  }
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Using learned hostlist `%s'\n",
-              pos->hostlist_uri);
-  current_hostlist = pos;
-  return GNUNET_strdup (pos->hostlist_uri);
+  /* keep the incomplete tail for the next chunk */
+  memcpy (&dl->buffer[dl->pos], cbuf, left);
+  dl->pos += left;
+  return total;
+ bogus:
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop
+                            ("# invalid HELLOs downloaded from hostlist servers"),
+                            1, GNUNET_NO);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              _("Invalid `%s' message received from hostlist at `%s'\n"),
+              "HELLO", dl->url);
+  dl->bogus = GNUNET_YES;
+  return total;
 }
 
 
@@ -647,6 +756,8 @@ insert_hostlist ()
     GNUNET_CONTAINER_DLL_remove (linked_list_head, linked_list_tail,
                                  lowest_quality);
     linked_list_size--;
+    if (NULL != lowest_quality->download)
+      lowest_quality->download->hostlist = NULL;
     GNUNET_free (lowest_quality);
   }
   GNUNET_CONTAINER_DLL_insert (linked_list_head, linked_list_tail,
@@ -659,94 +770,126 @@ insert_hostlist ()
 
 
 /**
- * Method updating hostlist statistics
+ * Method updating hostlist statistics after a download from a
+ * learned (or tested) hostlist finished.
+ *
+ * @param dl the download that finished
  */
 static void
-update_hostlist ()
+update_hostlist (struct Download *dl)
 {
+  struct Hostlist *hostlist = dl->hostlist;
   char *stat;
 
-  if (((stat_use_bootstrap == GNUNET_NO) && (NULL != current_hostlist)) ||
-      ((stat_testing_hostlist == GNUNET_YES) && (NULL != current_hostlist)))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Updating hostlist statics for URI `%s'\n",
-                current_hostlist->hostlist_uri);
-    current_hostlist->hello_count = stat_hellos_obtained;
-    current_hostlist->time_last_usage = GNUNET_TIME_absolute_get ();
-    current_hostlist->quality =
-        checked_add (current_hostlist->quality,
-                     (stat_hellos_obtained * HOSTLIST_SUCCESSFUL_HELLO));
-    if (GNUNET_YES == stat_download_successful)
-    {
-      current_hostlist->times_used++;
-      current_hostlist->quality =
-          checked_add (current_hostlist->quality, HOSTLIST_SUCCESSFUL_DOWNLOAD);
-      GNUNET_asprintf (&stat, gettext_noop ("# advertised URI `%s' downloaded"),
-                       current_hostlist->hostlist_uri);
-
-      GNUNET_STATISTICS_update (stats, stat, 1, GNUNET_YES);
-      GNUNET_free (stat);
-    }
-    else
-      current_hostlist->quality =
-          checked_sub (current_hostlist->quality, HOSTLIST_FAILED_DOWNLOAD);
-  }
-  current_hostlist = NULL;
-  /* Alternating the usage of preconfigured and learned hostlists */
-
-  if (stat_testing_hostlist == GNUNET_YES)
+  if (NULL == hostlist)
     return;
-
-  if (GNUNET_YES == stat_learning)
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Updating hostlist statics for URI `%s'\n",
+              hostlist->hostlist_uri);
+  hostlist->hello_count = dl->hellos;
+  hostlist->time_last_usage = GNUNET_TIME_absolute_get ();
+  hostlist->quality =
+      checked_add (hostlist->quality,
+                   (dl->hellos * HOSTLIST_SUCCESSFUL_HELLO));
+  if (GNUNET_YES == dl->successful)
   {
-    if (stat_use_bootstrap == GNUNET_YES)
-      stat_use_bootstrap = GNUNET_NO;
-    else
-      stat_use_bootstrap = GNUNET_YES;
+    hostlist->times_used++;
+    hostlist->quality =
+        checked_add (hostlist->quality, HOSTLIST_SUCCESSFUL_DOWNLOAD);
+    GNUNET_asprintf (&stat, gettext_noop ("# advertised URI `%s' downloaded"),
+                     hostlist->hostlist_uri);
+
+    GNUNET_STATISTICS_update (stats, stat, 1, GNUNET_YES);
+    GNUNET_free (stat);
   }
   else
-    stat_use_bootstrap = GNUNET_YES;
+    hostlist->quality =
+        checked_sub (hostlist->quality, HOSTLIST_FAILED_DOWNLOAD);
 }
 
 
 /**
- * Clean up the state from the task that downloaded the
- * hostlist and schedule the next task.
+ * Release the CURL handle and buffers of a download.
+ *
+ * @param dl download to free, must no longer be in the download list
  */
 static void
-clean_up ()
+free_download (struct Download *dl)
 {
-  CURLMcode mret;
+  if (NULL != dl->hostlist)
+    dl->hostlist->download = NULL;
+  if (NULL != dl->curl)
+    curl_easy_cleanup (dl->curl);
+  GNUNET_free (dl->url);
+  GNUNET_free (dl->buffer);
+  GNUNET_free (dl);
+}
 
-  if ((stat_testing_hostlist == GNUNET_YES) &&
-      (GNUNET_NO == stat_download_successful) && (NULL != hostlist_to_test))
+
+/**
+ * A download finished (or was aborted): update the quality of the
+ * hostlist, decide about a hostlist we were testing and release
+ * the download.
+ *
+ * @param dl the download
+ */
+static void
+finish_download (struct Download *dl)
+{
+  CURLMcode mret;
+  int testing;
+  int successful;
+
+  update_hostlist (dl);
+  testing = dl->testing;
+  successful = dl->successful;
+  GNUNET_CONTAINER_DLL_remove (download_head, download_tail, dl);
+  download_count--;
+  mret = curl_multi_remove_handle (multi, dl->curl);
+  if (mret != CURLM_OK)
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
+                "curl_multi_remove_handle", __FILE__, __LINE__,
+                curl_multi_strerror (mret));
+  free_download (dl);
+  if ((GNUNET_YES != testing) || (NULL == hostlist_to_test))
+    return;
+  if (GNUNET_YES == successful)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                _
-                ("Advertised hostlist with URI `%s' could not be downloaded. Advertised URI gets dismissed.\n"),
+                _("Adding successfully tested hostlist `%s' datastore.\n"),
                 hostlist_to_test->hostlist_uri);
+    insert_hostlist ();
   }
-
-  if (stat_testing_hostlist == GNUNET_YES)
-  {
-    stat_testing_hostlist = GNUNET_NO;
-  }
-  if (NULL != hostlist_to_test)
+  else
   {
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Advertised hostlist with URI `%s' could not be downloaded. Advertised URI gets dismissed.\n"),
+                hostlist_to_test->hostlist_uri);
     GNUNET_free (hostlist_to_test);
-    hostlist_to_test = NULL;
   }
+  hostlist_to_test = NULL;
+  stat_testing_hostlist = GNUNET_NO;
+}
+
+
+/**
+ * Clean up the state of the current download round: abort all
+ * downloads that are still running and release the multi handle.
+ */
+static void
+clean_up ()
+{
+  CURLMcode mret;
 
+  if (NULL != ti_download)
+  {
+    GNUNET_SCHEDULER_cancel (ti_download);
+    ti_download = NULL;
+  }
+  while (NULL != download_head)
+    finish_download (download_head);
   if (multi != NULL)
   {
-    mret = curl_multi_remove_handle (multi, curl);
-    if (mret != CURLM_OK)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
-                  "curl_multi_remove_handle", __FILE__, __LINE__,
-                  curl_multi_strerror (mret));
-    }
     mret = curl_multi_cleanup (multi);
     if (mret != CURLM_OK)
       GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
@@ -754,18 +897,234 @@ clean_up ()
                   curl_multi_strerror (mret));
     multi = NULL;
   }
-  if (curl != NULL)
+  if (NULL != known_hellos)
   {
-    curl_easy_cleanup (curl);
-    curl = NULL;
+    GNUNET_CONTAINER_multihashmap_destroy (known_hellos);
+    known_hellos = NULL;
   }
-  GNUNET_free_non_null (current_url);
-  current_url = NULL;
-  stat_bytes_downloaded = 0;
   stat_download_in_progress = GNUNET_NO;
 }
 
 
+/**
+ * Start downloading from the given URL as part of the current
+ * download round.
+ *
+ * @param url URL to download from
+ * @param hostlist learned hostlist the URL belongs to, NULL for
+ *        a preconfigured bootstrap server
+ * @param testing #GNUNET_YES if @a hostlist is the advertised
+ *        hostlist we are testing
+ * @return #GNUNET_OK on success, #GNUNET_NO if we are already
+ *         downloading from @a url, #GNUNET_SYSERR on error
+ */
+static int
+start_download (const char *url,
+                struct Hostlist *hostlist,
+                int testing)
+{
+  struct Download *dl;
+  CURLcode ret;
+  CURLMcode mret;
+
+  for (dl = download_head; NULL != dl; dl = dl->next)
+    if (0 == strcmp (dl->url, url))
+      return GNUNET_NO;
+  dl = GNUNET_new (struct Download);
+  dl->url = GNUNET_strdup (url);
+  dl->buffer = GNUNET_malloc (GNUNET_SERVER_MAX_MESSAGE_SIZE);
+  dl->testing = testing;
+  dl->successful = GNUNET_NO;
+  dl->bogus = GNUNET_NO;
+  dl->curl = curl_easy_init ();
+  if (NULL == dl->curl)
+  {
+    GNUNET_break (0);
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  if (NULL != proxy)
+  {
+    CURL_EASY_SETOPT (dl->curl, CURLOPT_PROXY, proxy);
+    CURL_EASY_SETOPT (dl->curl, CURLOPT_PROXYTYPE, proxy_type);
+    if (NULL != proxy_username)
+      CURL_EASY_SETOPT (dl->curl, CURLOPT_PROXYUSERNAME, proxy_username);
+    if (NULL != proxy_password)
+      CURL_EASY_SETOPT (dl->curl, CURLOPT_PROXYPASSWORD, proxy_password);
+  }
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_WRITEFUNCTION, &callback_download);
+  if (ret != CURLE_OK)
+  {
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_WRITEDATA, dl);
+  if (ret != CURLE_OK)
+  {
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_PRIVATE, dl);
+  if (ret != CURLE_OK)
+  {
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_FOLLOWLOCATION, 1);
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_MAXREDIRS, 4);
+  /* no need to abort if the above failed */
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_URL, dl->url);
+  if (ret != CURLE_OK)
+  {
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_FAILONERROR, 1);
+#if 0
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_VERBOSE, 1);
+#endif
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_BUFFERSIZE, GNUNET_SERVER_MAX_MESSAGE_SIZE);
+  /* let the server send the compressed hostlist */
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_ENCODING, "gzip");
+  if (0 == strncmp (dl->url, "http", 4))
+    CURL_EASY_SETOPT (dl->curl, CURLOPT_USERAGENT, "GNUnet");
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_CONNECTTIMEOUT, 60L);
+  CURL_EASY_SETOPT (dl->curl, CURLOPT_TIMEOUT, 60L);
+  mret = curl_multi_add_handle (multi, dl->curl);
+  if (mret != CURLM_OK)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
+                "curl_multi_add_handle", __FILE__, __LINE__,
+                curl_multi_strerror (mret));
+    free_download (dl);
+    return GNUNET_SYSERR;
+  }
+  dl->hostlist = hostlist;
+  if (NULL != hostlist)
+    hostlist->download = dl;
+  GNUNET_CONTAINER_DLL_insert (download_head, download_tail, dl);
+  download_count++;
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
+              _("Bootstrapping using hostlist at `%s'.\n"), dl->url);
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# hostlist downloads initiated"), 1,
+                            GNUNET_NO);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Start testing the advertised hostlist in the current download
+ * round; the hostlist is dismissed if that fails.
+ *
+ * @return #GNUNET_OK if the test download was started
+ */
+static int
+start_test_download ()
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Testing new advertised hostlist if it is obtainable\n");
+  if (GNUNET_OK ==
+      start_download (hostlist_to_test->hostlist_uri, hostlist_to_test,
+                      GNUNET_YES))
+    return GNUNET_OK;
+  GNUNET_free (hostlist_to_test);
+  hostlist_to_test = NULL;
+  stat_testing_hostlist = GNUNET_NO;
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Start downloads from the learned hostlists with the best quality
+ * that we are not downloading from yet.
+ *
+ * @param max maximum number of downloads to start
+ * @return number of downloads started
+ */
+static unsigned int
+start_learned_downloads (unsigned int max)
+{
+  struct Hostlist *pos;
+  struct Hostlist *best;
+  unsigned int started;
+
+  started = 0;
+  while (started < max)
+  {
+    best = NULL;
+    for (pos = linked_list_head; NULL != pos; pos = pos->next)
+      if ((NULL == pos->download) &&
+          ((NULL == best) || (pos->quality > best->quality)))
+        best = pos;
+    if (NULL == best)
+      break;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Using learned hostlist `%s'\n",
+                best->hostlist_uri);
+    if (GNUNET_OK != start_download (best->hostlist_uri, best, GNUNET_NO))
+      break;
+    started++;
+  }
+  return started;
+}
+
+
+/**
+ * Start downloads from randomly chosen preconfigured bootstrap
+ * servers.
+ *
+ * @param max maximum number of downloads to start
+ * @return number of downloads started
+ */
+static unsigned int
+start_bootstrap_downloads (unsigned int max)
+{
+  char *servers;
+  char *tok;
+  char **urls;
+  unsigned int urls_len;
+  unsigned int *perm;
+  unsigned int started;
+  unsigned int i;
+
+  if (0 == max)
+    return 0;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_string (cfg, "HOSTLIST", "SERVERS",
+                                             &servers))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_WARNING,
+			       "hostlist", "SERVERS");
+    return 0;
+  }
+  urls = NULL;
+  urls_len = 0;
+  for (tok = strtok (servers, " "); NULL != tok; tok = strtok (NULL, " "))
+    GNUNET_array_append (urls, urls_len, tok);
+  if (0 == urls_len)
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_WARNING,
+			       "hostlist", "SERVERS");
+    GNUNET_free (servers);
+    return 0;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Using preconfigured bootstrap server\n");
+  perm = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_WEAK, urls_len);
+  started = 0;
+  for (i = 0; (i < urls_len) && (started < max); i++)
+    if (GNUNET_OK == start_download (urls[perm[i]], NULL, GNUNET_NO))
+      started++;
+  GNUNET_free (perm);
+  GNUNET_array_grow (urls, urls_len, 0);
+  GNUNET_free (servers);
+  return started;
+}
+
+
 /**
  * Task that is run when we are ready to receive more data from the hostlist
  * server.
@@ -838,7 +1197,7 @@ download_prepare ()
 
 /**
  * Task that is run when we are ready to receive more data from the hostlist
- * server.
+ * servers.
  *
  * @param cls closure, unused
  * @param tc task context, unused
@@ -850,23 +1209,24 @@ task_download (void *cls,
   int running;
   struct CURLMsg *msg;
   CURLMcode mret;
+  CURLcode result;
+  struct Download *dl;
+  char *priv;
 
   ti_download = NULL;
   if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Shutdown requested while trying to download hostlist from `%s'\n",
-                current_url);
-    update_hostlist ();
+                "Shutdown requested while trying to download hostlists\n");
     clean_up ();
     return;
   }
   if (0 == GNUNET_TIME_absolute_get_remaining (end_time).rel_value_us)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Timeout trying to download hostlist from `%s'\n"),
-                current_url);
-    update_hostlist ();
+    for (dl = download_head; NULL != dl; dl = dl->next)
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Timeout trying to download hostlist from `%s'\n"),
+                  dl->url);
     clean_up ();
     return;
   }
@@ -875,168 +1235,96 @@ task_download (void *cls,
   do
   {
     running = 0;
-    if (stat_bytes_downloaded > MAX_BYTES_PER_HOSTLISTS)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                  _("Download limit of %u bytes exceeded, stopping download\n"),
-                  MAX_BYTES_PER_HOSTLISTS);
-      clean_up ();
-      return;
-    }
     mret = curl_multi_perform (multi, &running);
-    if (running == 0)
-    {
-      do
-      {
-        msg = curl_multi_info_read (multi, &running);
-        GNUNET_break (msg != NULL);
-        if (msg == NULL)
-          break;
-        switch (msg->msg)
-        {
-        case CURLMSG_DONE:
-          if ((msg->data.result != CURLE_OK) &&
-              (msg->data.result != CURLE_GOT_NOTHING))
-            GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                        _("Download of hostlist from `%s' failed: `%s'\n"),
-                        current_url,
-                        curl_easy_strerror (msg->data.result));
-          else
-          {
-            GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                        _("Download of hostlist `%s' completed.\n"),
-                        current_url);
-            stat_download_successful = GNUNET_YES;
-            update_hostlist ();
-            if (GNUNET_YES == stat_testing_hostlist)
-            {
-              GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                          _
-                          ("Adding successfully tested hostlist `%s' datastore.\n"),
-                          current_url);
-              insert_hostlist ();
-              hostlist_to_test = NULL;
-              stat_testing_hostlist = GNUNET_NO;
-            }
-          }
-          clean_up ();
-          return;
-        default:
-          break;
-        }
-
-      }
-      while ((running > 0));
-    }
   }
   while (mret == CURLM_CALL_MULTI_PERFORM);
-
   if (mret != CURLM_OK)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO, _("%s failed at %s:%d: `%s'\n"),
                 "curl_multi_perform", __FILE__, __LINE__,
                 curl_multi_strerror (mret));
     clean_up ();
+    return;
+  }
+  while (NULL != (msg = curl_multi_info_read (multi, &running)))
+  {
+    if (CURLMSG_DONE != msg->msg)
+      continue;
+    priv = NULL;
+    curl_easy_getinfo (msg->easy_handle, CURLINFO_PRIVATE, &priv);
+    dl = (struct Download *) priv;
+    if (NULL == dl)
+    {
+      GNUNET_break (0);
+      continue;
+    }
+    result = msg->data.result;
+    if ((result != CURLE_OK) &&
+        (result != CURLE_GOT_NOTHING))
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Download of hostlist from `%s' failed: `%s'\n"),
+                  dl->url,
+                  curl_easy_strerror (result));
+    else
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                  _("Download of hostlist `%s' completed.\n"),
+                  dl->url);
+      dl->successful = GNUNET_YES;
+    }
+    /* invalidates 'msg' */
+    finish_download (dl);
+  }
+  if (0 == download_count)
+  {
+    clean_up ();
+    return;
   }
   download_prepare ();
 }
 
 
 /**
- * Main function that will download a hostlist and process its
- * data.
+ * Main function that will start a download round: fetch hostlists
+ * from up to #parallel_downloads servers at the same time (the
+ * advertised hostlist we are testing, the learned hostlists with
+ * the best quality and preconfigured bootstrap servers) and process
+ * their data as it arrives.
  */
 static void
 download_hostlist ()
 {
-  CURLcode ret;
-  CURLMcode mret;
-
+  unsigned int slots;
+  unsigned int learned;
 
-  current_url = download_get_url ();
-  if (current_url == NULL)
-    return;
-  curl = curl_easy_init ();
-  multi = NULL;
-  if (curl == NULL)
+  multi = curl_multi_init ();
+  if (multi == NULL)
   {
     GNUNET_break (0);
-    clean_up ();
     return;
   }
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
-              _("Bootstrapping using hostlist at `%s'.\n"), current_url);
-
+  known_hellos = GNUNET_CONTAINER_multihashmap_create (1024, GNUNET_NO);
   stat_download_in_progress = GNUNET_YES;
-  stat_download_successful = GNUNET_NO;
-  stat_hellos_obtained = 0;
-  stat_bytes_downloaded = 0;
-
-  GNUNET_STATISTICS_update (stats,
-                            gettext_noop ("# hostlist downloads initiated"), 1,
-                            GNUNET_NO);
-  if (NULL != proxy)
-  {
-    CURL_EASY_SETOPT (curl, CURLOPT_PROXY, proxy);
-    CURL_EASY_SETOPT (curl, CURLOPT_PROXYTYPE, proxy_type);
-    if (NULL != proxy_username)
-      CURL_EASY_SETOPT (curl, CURLOPT_PROXYUSERNAME, proxy_username);
-    if (NULL != proxy_password)
-      CURL_EASY_SETOPT (curl, CURLOPT_PROXYPASSWORD, proxy_password);
-  }
-  download_pos = 0;
-  stat_bogus_url = 0;
-  CURL_EASY_SETOPT (curl, CURLOPT_WRITEFUNCTION, &callback_download);
-  if (ret != CURLE_OK)
-  {
-    clean_up ();
-    return;
-  }
-  CURL_EASY_SETOPT (curl, CURLOPT_WRITEDATA, NULL);
-  if (ret != CURLE_OK)
-  {
-    clean_up ();
-    return;
-  }
-  CURL_EASY_SETOPT (curl, CURLOPT_FOLLOWLOCATION, 1);
-  CURL_EASY_SETOPT (curl, CURLOPT_REDIR_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
-  CURL_EASY_SETOPT (curl, CURLOPT_PROTOCOLS, CURLPROTO_HTTP | CURLPROTO_HTTPS);
-  CURL_EASY_SETOPT (curl, CURLOPT_MAXREDIRS, 4);
-  /* no need to abort if the above failed */
-  CURL_EASY_SETOPT (curl, CURLOPT_URL, current_url);
-  if (ret != CURLE_OK)
-  {
-    clean_up ();
-    return;
-  }
-  CURL_EASY_SETOPT (curl, CURLOPT_FAILONERROR, 1);
-#if 0
-  CURL_EASY_SETOPT (curl, CURLOPT_VERBOSE, 1);
-#endif
-  CURL_EASY_SETOPT (curl, CURLOPT_BUFFERSIZE, GNUNET_SERVER_MAX_MESSAGE_SIZE);
-  if (0 == strncmp (current_url, "http", 4))
-    CURL_EASY_SETOPT (curl, CURLOPT_USERAGENT, "GNUnet");
-  CURL_EASY_SETOPT (curl, CURLOPT_CONNECTTIMEOUT, 60L);
-  CURL_EASY_SETOPT (curl, CURLOPT_TIMEOUT, 60L);
-  multi = curl_multi_init ();
-  if (multi == NULL)
+  slots = parallel_downloads;
+  if ((GNUNET_YES == stat_testing_hostlist) && (NULL != hostlist_to_test) &&
+      (GNUNET_OK == start_test_download ()))
+    slots--;
+  if (GNUNET_YES == stat_learning)
   {
-    GNUNET_break (0);
-    /* clean_up (); */
-    return;
+    /* split the remaining slots between learned hostlists and the
+       bootstrap servers, alternating who gets the odd one */
+    learned = slots / 2;
+    if ((0 != slots % 2) && (GNUNET_NO == stat_use_bootstrap))
+      learned++;
+    stat_use_bootstrap = (GNUNET_YES == stat_use_bootstrap) ? GNUNET_NO : GNUNET_YES;
+    slots -= start_learned_downloads (learned);
   }
-  mret = curl_multi_add_handle (multi, curl);
-  if (mret != CURLM_OK)
+  slots -= start_bootstrap_downloads (slots);
+  /* fewer bootstrap servers than slots, use more learned hostlists */
+  if (GNUNET_YES == stat_learning)
+    slots -= start_learned_downloads (slots);
+  if (0 == download_count)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
-                "curl_multi_add_handle", __FILE__, __LINE__,
-                curl_multi_strerror (mret));
-    mret = curl_multi_cleanup (multi);
-    if (mret != CURLM_OK)
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("%s failed at %s:%d: `%s'\n"),
-                  "curl_multi_cleanup", __FILE__, __LINE__,
-                  curl_multi_strerror (mret));
-    multi = NULL;
     clean_up ();
     return;
   }
@@ -1058,6 +1346,14 @@ task_download_dispatcher (void *cls,
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Download can start immediately...\n");
     download_hostlist ();
   }
+  else if ((GNUNET_YES == stat_testing_hostlist) &&
+           (NULL != hostlist_to_test) &&
+           (NULL == hostlist_to_test->download))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Download in progress, adding advertised hostlist to it...\n");
+    (void) start_test_download ();
+  }
   else
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1521,6 +1817,7 @@ GNUNET_HOSTLIST_client_start (const struct GNUNET_CONFIGURATION_Handle *c,
 {
   char *filename;
   char *proxytype_str;
+  unsigned long long parallel;
   int result;
 
   GNUNET_assert (NULL != st);
@@ -1606,6 +1903,14 @@ GNUNET_HOSTLIST_client_start (const struct GNUNET_CONFIGURATION_Handle *c,
     GNUNET_free_non_null (proxytype_str);
   }
 
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg, "HOSTLIST",
+                                             "PARALLEL_DOWNLOADS",
+                                             &parallel))
+    parallel = DEFAULT_PARALLEL_DOWNLOADS;
+  parallel_downloads = (unsigned int) GNUNET_MAX (1,
+                                                  GNUNET_MIN (parallel,
+                                                              MAX_NUMBER_HOSTLISTS));
   stat_learning = learn;
   *ch = &handler_connect;
   *dh = &handler_disconnect;
@@ -1678,12 +1983,29 @@ GNUNET_HOSTLIST_client_start (const struct GNUNET_CONFIGURATION_Handle *c,
 void
 GNUNET_HOSTLIST_client_stop ()
 {
+  struct PendingHello *ph;
+
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Hostlist client shutdown\n");
   if (NULL != sget)
   {
     GNUNET_STATISTICS_get_cancel (sget);
     sget = NULL;
   }
+  if (GNUNET_YES == stat_download_in_progress)
+    clean_up ();
+  GNUNET_free_non_null (hostlist_to_test);
+  hostlist_to_test = NULL;
+  if (NULL != ti_offer_hellos)
+  {
+    GNUNET_SCHEDULER_cancel (ti_offer_hellos);
+    ti_offer_hellos = NULL;
+  }
+  while (NULL != (ph = pending_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pending_head, pending_tail, ph);
+    GNUNET_free (ph);
+  }
+  pending_count = 0;
   stats = NULL;
   if (GNUNET_YES == stat_learning)
     save_hostlist_file (GNUNET_YES);
@@ -1703,11 +2025,6 @@ GNUNET_HOSTLIST_client_stop ()
     GNUNET_SCHEDULER_cancel (ti_testing_intervall_task);
     ti_testing_intervall_task = NULL;
   }
-  if (ti_download != NULL)
-  {
-    GNUNET_SCHEDULER_cancel (ti_download);
-    ti_download = NULL;
-  }
   if (ti_check_download != NULL)
   {
     GNUNET_SCHEDULER_cancel (ti_check_download);
@@ -27,6 +27,10 @@
  */
 #include "platform.h"
 #include <microhttpd.h>
+#include <zlib.h>
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include "gnunet-daemon-hostlist_server.h"
 #include "gnunet_hello_lib.h"
 #include "gnunet_peerinfo_service.h"
@@ -40,6 +44,30 @@
  */
 #define GNUNET_ADV_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
 
+/**
+ * How often do we rebuild our hostlist response at most?  Changes
+ * reported by PEERINFO within this period are coalesced into a
+ * single rebuild.  Also used as the `max-age` for HTTP caches.
+ */
+#define HOSTLIST_REBUILD_FREQ GNUNET_TIME_UNIT_MINUTES
+
+/**
+ * How long do we wait for more changes before building the
+ * first hostlist response?
+ */
+#define HOSTLIST_INITIAL_BUILD_DELAY GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * How often do we report the request counters of the HTTP
+ * threads to statistics?
+ */
+#define HOSTLIST_STATS_FREQ GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 15)
+
+/**
+ * Maximum number of HTTP threads per address family.
+ */
+#define HOSTLIST_MAX_HTTP_THREADS 64
+
 
 /**
  * Handle to the HTTP server as provided by libmicrohttpd for IPv6.
@@ -86,6 +114,109 @@ static struct GNUNET_SCHEDULER_Task * hostlist_task_v6;
  */
 static struct MHD_Response *response;
 
+/**
+ * Our canonical response compressed with gzip, NULL if compression
+ * did not pay off.
+ */
+static struct MHD_Response *response_gzip;
+
+/**
+ * Response to conditional requests for our current hostlist.
+ */
+static struct MHD_Response *response_not_modified;
+
+/**
+ * Entity tag of our current response (derived from its hash).
+ */
+static char etag[32];
+
+/**
+ * Time our current response was built, as HTTP date.
+ */
+static char last_modified[64];
+
+/**
+ * If set, name of the file where we keep our current response so
+ * that MHD can serve it using sendfile (and `.gz` for the
+ * compressed variant).
+ */
+static char *response_file;
+
+/**
+ * Number of threads MHD uses per daemon, 0 to run MHD in our
+ * scheduler.
+ */
+static unsigned int http_threads;
+
+/**
+ * Task to start the next rebuild of the response.
+ */
+static struct GNUNET_SCHEDULER_Task *rebuild_task;
+
+/**
+ * Task reporting the request counters of the HTTP threads.
+ */
+static struct GNUNET_SCHEDULER_Task *stats_task;
+
+/**
+ * #GNUNET_YES if PEERINFO reported changes while we were building
+ * the response.
+ */
+static int rebuild_pending;
+
+/**
+ * When did we last start to build the response?
+ */
+static struct GNUNET_TIME_Absolute last_build;
+
+#if HAVE_PTHREAD
+/**
+ * Lock protecting the responses and #request_stats if MHD
+ * uses its own threads.
+ */
+static pthread_mutex_t response_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/**
+ * Counters for requests, see #request_stats.
+ */
+enum RequestStat
+{
+  RS_REFUSED_METHOD = 0,
+  RS_REFUSED_UPLOAD,
+  RS_REFUSED_NOT_READY,
+  RS_PROCESSED,
+  RS_NOT_MODIFIED,
+  RS_GZIP,
+  RS_MAX
+};
+
+
+/**
+ * Request counters that are updated by the HTTP threads and
+ * reported to statistics from the main thread.
+ */
+static struct
+{
+  /**
+   * Name of the statistic.
+   */
+  const char *name;
+
+  /**
+   * Number of requests not yet reported.
+   */
+  unsigned long long pending;
+} request_stats[RS_MAX] = {
+  { gettext_noop ("hostlist requests refused (not HTTP GET)"), 0 },
+  { gettext_noop ("hostlist requests refused (upload data)"), 0 },
+  { gettext_noop ("hostlist requests refused (not ready)"), 0 },
+  { gettext_noop ("hostlist requests processed"), 0 },
+  { gettext_noop ("hostlist requests answered with not modified"), 0 },
+  { gettext_noop ("hostlist requests answered with gzip"), 0 }
+};
+
 /**
  * Handle for accessing peerinfo service.
  */
@@ -159,30 +290,363 @@ add_cors_headers (struct MHD_Response *response)
 
 
 /**
- * Function that assembles our response.
+ * Acquire the lock protecting the responses (if MHD uses threads).
+ */
+static void
+lock_responses ()
+{
+#if HAVE_PTHREAD
+  if (0 != http_threads)
+    GNUNET_assert (0 == pthread_mutex_lock (&response_lock));
+#endif
+}
+
+
+/**
+ * Release the lock protecting the responses (if MHD uses threads).
+ */
+static void
+unlock_responses ()
+{
+#if HAVE_PTHREAD
+  if (0 != http_threads)
+    GNUNET_assert (0 == pthread_mutex_unlock (&response_lock));
+#endif
+}
+
+
+/**
+ * Count a request.  If MHD uses threads, the counter is reported
+ * to statistics later by #report_request_stats().
+ *
+ * @param rs which counter to increment
+ */
+static void
+count_request (enum RequestStat rs)
+{
+  if (0 == http_threads)
+  {
+    GNUNET_STATISTICS_update (stats,
+                              request_stats[rs].name,
+                              1,
+                              GNUNET_YES);
+    return;
+  }
+  lock_responses ();
+  request_stats[rs].pending++;
+  unlock_responses ();
+}
+
+
+/**
+ * Report the request counters of the HTTP threads to statistics.
+ *
+ * @param cls NULL
+ * @param tc scheduler context, NULL for a final report
+ */
+static void
+report_request_stats (void *cls,
+                      const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  unsigned long long pending[RS_MAX];
+  unsigned int i;
+
+  stats_task = NULL;
+  lock_responses ();
+  for (i = 0; i < RS_MAX; i++)
+  {
+    pending[i] = request_stats[i].pending;
+    request_stats[i].pending = 0;
+  }
+  unlock_responses ();
+  for (i = 0; i < RS_MAX; i++)
+    if (0 != pending[i])
+      GNUNET_STATISTICS_update (stats,
+                                request_stats[i].name,
+                                pending[i],
+                                GNUNET_YES);
+  if ( (NULL == tc) ||
+       (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN)) )
+    return;
+  stats_task = GNUNET_SCHEDULER_add_delayed (HOSTLIST_STATS_FREQ,
+                                             &report_request_stats,
+                                             NULL);
+}
+
+
+/**
+ * Compress the hostlist with gzip.
+ *
+ * @param data the hostlist
+ * @param size number of bytes in @a data
+ * @param[out] gz_size set to the number of bytes of the result
+ * @return the compressed hostlist, NULL on error or if compression
+ *         did not make it smaller
+ */
+static char *
+compress_gzip (const char *data,
+               size_t size,
+               size_t *gz_size)
+{
+  z_stream strm;
+  char *out;
+  size_t bound;
+  int ret;
+
+  memset (&strm, 0, sizeof (strm));
+  /* 15 + 16: maximum window with gzip header */
+  if (Z_OK != deflateInit2 (&strm,
+                            Z_BEST_COMPRESSION,
+                            Z_DEFLATED,
+                            15 + 16,
+                            8,
+                            Z_DEFAULT_STRATEGY))
+    return NULL;
+  bound = deflateBound (&strm, size) + 18;
+  out = GNUNET_malloc (bound);
+  strm.next_in = (Bytef *) data;
+  strm.avail_in = size;
+  strm.next_out = (Bytef *) out;
+  strm.avail_out = bound;
+  ret = deflate (&strm, Z_FINISH);
+  *gz_size = strm.total_out;
+  (void) deflateEnd (&strm);
+  if ( (Z_STREAM_END != ret) ||
+       (*gz_size >= size) )
+  {
+    GNUNET_free (out);
+    return NULL;
+  }
+  return out;
+}
+
+
+/**
+ * Create an MHD response for the given data.  If #response_file is
+ * set, the data is written to a file and served from there (so that
+ * MHD can use sendfile), otherwise it is served from memory.
+ *
+ * @param data data to serve, will be freed
+ * @param size number of bytes in @a data
+ * @param suffix suffix to append to #response_file
+ * @return the response, NULL on error
+ */
+static struct MHD_Response *
+create_response (char *data,
+                 size_t size,
+                 const char *suffix)
+{
+  struct MHD_Response *r;
+  char *fn;
+  char *tmp;
+  int fd;
+
+  if (NULL != response_file)
+  {
+    GNUNET_asprintf (&fn, "%s%s", response_file, suffix);
+    GNUNET_asprintf (&tmp, "%s.tmp", fn);
+    fd = -1;
+    /* never modify a file MHD may still be serving, replace it */
+    if ( ((ssize_t) size ==
+          GNUNET_DISK_fn_write (tmp, data, size,
+                                GNUNET_DISK_PERM_USER_READ |
+                                GNUNET_DISK_PERM_USER_WRITE |
+                                GNUNET_DISK_PERM_GROUP_READ |
+                                GNUNET_DISK_PERM_OTHER_READ)) &&
+         (0 == RENAME (tmp, fn)) )
+      fd = OPEN (fn, O_RDONLY);
+    if (-1 == fd)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "write",
+                                fn);
+      (void) UNLINK (tmp);
+    }
+    GNUNET_free (tmp);
+    GNUNET_free (fn);
+    if (-1 != fd)
+    {
+      r = MHD_create_response_from_fd (size, fd);
+      if (NULL != r)
+      {
+        GNUNET_free_non_null (data);
+        return r;
+      }
+      GNUNET_break (0 == CLOSE (fd));
+    }
+  }
+  return MHD_create_response_from_buffer (size,
+                                          data,
+                                          MHD_RESPMEM_MUST_FREE);
+}
+
+
+/**
+ * Add headers to a response that allow HTTP caches and clients to
+ * revalidate the hostlist cheaply.
+ *
+ * @param r response to add headers to
+ * @param tag entity tag of the hostlist
+ * @param date build time of the hostlist as HTTP date
+ */
+static void
+add_cache_headers (struct MHD_Response *r,
+                   const char *tag,
+                   const char *date)
+{
+  char cc[64];
+
+  GNUNET_snprintf (cc,
+                   sizeof (cc),
+                   "public, max-age=%llu",
+                   (unsigned long long)
+                   (HOSTLIST_REBUILD_FREQ.rel_value_us / 1000LL / 1000LL));
+  MHD_add_response_header (r, MHD_HTTP_HEADER_ETAG, tag);
+  MHD_add_response_header (r, MHD_HTTP_HEADER_LAST_MODIFIED, date);
+  MHD_add_response_header (r, MHD_HTTP_HEADER_CACHE_CONTROL, cc);
+  MHD_add_response_header (r, MHD_HTTP_HEADER_VARY, "Accept-Encoding");
+}
+
+
+/**
+ * Format the current time as HTTP date (RFC 7231, IMF-fixdate).
+ *
+ * @param buf where to write the date
+ * @param size number of bytes in @a buf
+ */
+static void
+get_http_date (char *buf,
+               size_t size)
+{
+  static const char *const days[] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+  };
+  static const char *const months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+    "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+  };
+  time_t now;
+  struct tm tm;
+
+  now = time (NULL);
+  GNUNET_assert (NULL != gmtime_r (&now, &tm));
+  GNUNET_snprintf (buf,
+                   size,
+                   "%s, %02d %s %04d %02d:%02d:%02d GMT",
+                   days[tm.tm_wday],
+                   tm.tm_mday,
+                   months[tm.tm_mon],
+                   tm.tm_year + 1900,
+                   tm.tm_hour,
+                   tm.tm_min,
+                   tm.tm_sec);
+}
+
+
+/**
+ * Function that assembles our response.  Builds the plain and the
+ * gzip'd variant of the response once, so that requests only need
+ * to pick the right one.  If the hostlist did not change, the old
+ * responses (and their entity tag) are kept.
  */
 static void
 finish_response ()
 {
-  if (NULL != response)
-    MHD_destroy_response (response);
+  struct GNUNET_HashCode hc;
+  struct MHD_Response *r;
+  struct MHD_Response *r_gzip;
+  struct MHD_Response *r_not_modified;
+  struct MHD_Response *old;
+  char new_etag[sizeof (etag)];
+  char new_date[sizeof (last_modified)];
+  char *gz;
+  size_t gz_size;
+  size_t size;
+
+  size = builder->size;
+  GNUNET_CRYPTO_hash (builder->data, size, &hc);
+  GNUNET_snprintf (new_etag,
+                   sizeof (new_etag),
+                   "\"%08x%08x\"",
+                   ntohl (hc.bits[0]),
+                   ntohl (hc.bits[1]));
+  if ( ( (NULL == daemon_handle_v4) && (NULL == daemon_handle_v6) ) ||
+       ( (NULL != response) && (0 == strcmp (new_etag, etag)) ) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Hostlist with %u bytes unchanged\n",
+                (unsigned int) size);
+    GNUNET_free_non_null (builder->data);
+    GNUNET_free (builder);
+    builder = NULL;
+    return;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Creating hostlist response with %u bytes\n",
-              (unsigned int) builder->size);
-  response =
-      MHD_create_response_from_buffer (builder->size,
-                                       builder->data,
-                                       MHD_RESPMEM_MUST_FREE);
-  add_cors_headers (response);
-  if ((NULL == daemon_handle_v4) && (NULL == daemon_handle_v6))
+              (unsigned int) size);
+  get_http_date (new_date, sizeof (new_date));
+  gz = compress_gzip (builder->data, size, &gz_size);
+  r = create_response (builder->data, size, "");
+  builder->data = NULL;
+  r_gzip = NULL;
+  if (NULL != gz)
   {
-    MHD_destroy_response (response);
-    response = NULL;
+    r_gzip = create_response (gz, gz_size, ".gz");
+    GNUNET_STATISTICS_set (stats, gettext_noop ("bytes in compressed hostlist"),
+                           gz_size, GNUNET_YES);
   }
-  GNUNET_STATISTICS_set (stats, gettext_noop ("bytes in hostlist"),
-                         builder->size, GNUNET_YES);
+  r_not_modified = MHD_create_response_from_buffer (0, NULL,
+                                                    MHD_RESPMEM_PERSISTENT);
   GNUNET_free (builder);
   builder = NULL;
+  if ( (NULL == r) ||
+       (NULL == r_not_modified) )
+  {
+    GNUNET_break (0);
+    if (NULL != r)
+      MHD_destroy_response (r);
+    if (NULL != r_gzip)
+      MHD_destroy_response (r_gzip);
+    if (NULL != r_not_modified)
+      MHD_destroy_response (r_not_modified);
+    return;
+  }
+  add_cors_headers (r);
+  add_cache_headers (r, new_etag, new_date);
+  add_cors_headers (r_not_modified);
+  add_cache_headers (r_not_modified, new_etag, new_date);
+  if (NULL != r_gzip)
+  {
+    add_cors_headers (r_gzip);
+    add_cache_headers (r_gzip, new_etag, new_date);
+    MHD_add_response_header (r_gzip,
+                             MHD_HTTP_HEADER_CONTENT_ENCODING,
+                             "gzip");
+  }
+
+  /* swap in the new responses; MHD keeps the old ones alive
+     for connections that are still using them */
+  lock_responses ();
+  old = response;
+  response = r;
+  r = old;
+  old = response_gzip;
+  response_gzip = r_gzip;
+  r_gzip = old;
+  old = response_not_modified;
+  response_not_modified = r_not_modified;
+  r_not_modified = old;
+  strcpy (etag, new_etag);
+  strcpy (last_modified, new_date);
+  unlock_responses ();
+  if (NULL != r)
+    MHD_destroy_response (r);
+  if (NULL != r_gzip)
+    MHD_destroy_response (r_gzip);
+  if (NULL != r_not_modified)
+    MHD_destroy_response (r_not_modified);
+  GNUNET_STATISTICS_set (stats, gettext_noop ("bytes in hostlist"),
+                         size, GNUNET_YES);
 }
 
 
@@ -213,6 +677,14 @@ check_has_addr (void *cls,
 }
 
 
+/**
+ * Schedule a rebuild of the hostlist response, at most once
+ * per #HOSTLIST_REBUILD_FREQ.
+ */
+static void
+schedule_rebuild (void);
+
+
 /**
  * Callback that processes each of the known HELLOs for the
  * hostlist response construction.
@@ -238,15 +710,19 @@ host_processor (void *cls,
     builder->pitr = NULL;
     GNUNET_free_non_null (builder->data);
     GNUNET_free (builder);
+    builder = NULL;
     GNUNET_log (GNUNET_ERROR_TYPE_INFO,
                 _("Error in communication with PEERINFO service: %s\n"),
                 err_msg);
+    schedule_rebuild ();
     return;
   }
   if (NULL == peer)
   {
     builder->pitr = NULL;
     finish_response ();
+    if (GNUNET_YES == rebuild_pending)
+      schedule_rebuild ();
     return;
   }
   if (NULL == hello)
@@ -311,13 +787,16 @@ accept_policy_callback (void *cls,
                         const struct sockaddr *addr,
                         socklen_t addrlen)
 {
-  if (NULL == response)
-  {
+  int ready;
+
+  lock_responses ();
+  ready = (NULL != response) ? MHD_YES : MHD_NO;
+  unlock_responses ();
+  if ( (MHD_NO == ready) &&
+       (0 == http_threads) )
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Received request for hostlist, but I am not yet ready; rejecting!\n");
-    return MHD_NO;
-  }
-  return MHD_YES;               /* accept all */
+  return ready;                 /* accept all once we are ready */
 }
 
 
@@ -367,6 +846,11 @@ access_handler_callback (void *cls,
                          void **con_cls)
 {
   static int dummy;
+  const char *if_none_match;
+  const char *if_modified_since;
+  const char *accept_encoding;
+  enum RequestStat stat;
+  int ret;
 
   /* CORS pre-flight request */
   if (0 == strcmp (MHD_HTTP_METHOD_OPTIONS, method))
@@ -383,12 +867,10 @@ access_handler_callback (void *cls,
   }
   if (0 != strcmp (method, MHD_HTTP_METHOD_GET))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Refusing `%s' request to hostlist server\n"), method);
-    GNUNET_STATISTICS_update (stats,
-                              gettext_noop
-                              ("hostlist requests refused (not HTTP GET)"), 1,
-                              GNUNET_YES);
+    if (0 == http_threads)
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Refusing `%s' request to hostlist server\n"), method);
+    count_request (RS_REFUSED_METHOD);
     return MHD_NO;
   }
   if (NULL == *con_cls)
@@ -398,31 +880,66 @@ access_handler_callback (void *cls,
   }
   if (0 != *upload_data_size)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Refusing `%s' request with %llu bytes of upload data\n"),
-                method, (unsigned long long) *upload_data_size);
-    GNUNET_STATISTICS_update (stats,
-                              gettext_noop
-                              ("hostlist requests refused (upload data)"), 1,
-                              GNUNET_YES);
+    if (0 == http_threads)
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Refusing `%s' request with %llu bytes of upload data\n"),
+                  method, (unsigned long long) *upload_data_size);
+    count_request (RS_REFUSED_UPLOAD);
     return MHD_NO;              /* do not support upload data */
   }
+  if_none_match = MHD_lookup_connection_value (connection,
+                                               MHD_HEADER_KIND,
+                                               MHD_HTTP_HEADER_IF_NONE_MATCH);
+  if_modified_since = MHD_lookup_connection_value (connection,
+                                                   MHD_HEADER_KIND,
+                                                   MHD_HTTP_HEADER_IF_MODIFIED_SINCE);
+  accept_encoding = MHD_lookup_connection_value (connection,
+                                                 MHD_HEADER_KIND,
+                                                 MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  lock_responses ();
   if (NULL == response)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Could not handle hostlist request since I do not have a response yet\n"));
-    GNUNET_STATISTICS_update (stats,
-                              gettext_noop
-                              ("hostlist requests refused (not ready)"), 1,
-                              GNUNET_YES);
+    unlock_responses ();
+    if (0 == http_threads)
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Could not handle hostlist request since I do not have a response yet\n"));
+    count_request (RS_REFUSED_NOT_READY);
     return MHD_NO;              /* internal error, no response yet */
   }
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-              _("Received request for our hostlist\n"));
-  GNUNET_STATISTICS_update (stats,
-                            gettext_noop ("hostlist requests processed"),
-                            1, GNUNET_YES);
-  return MHD_queue_response (connection, MHD_HTTP_OK, response);
+  /* If-None-Match takes precedence over If-Modified-Since; as we
+     only ever send our own date, comparing the strings suffices */
+  if ( ( (NULL != if_none_match) &&
+         ( (NULL != strstr (if_none_match, etag)) ||
+           (0 == strcmp (if_none_match, "*")) ) ) ||
+       ( (NULL == if_none_match) &&
+         (NULL != if_modified_since) &&
+         (0 == strcmp (if_modified_since, last_modified)) ) )
+  {
+    ret = MHD_queue_response (connection,
+                              MHD_HTTP_NOT_MODIFIED,
+                              response_not_modified);
+    stat = RS_NOT_MODIFIED;
+  }
+  else if ( (NULL != response_gzip) &&
+            (NULL != accept_encoding) &&
+            (NULL != strstr (accept_encoding, "gzip")) )
+  {
+    ret = MHD_queue_response (connection, MHD_HTTP_OK, response_gzip);
+    stat = RS_GZIP;
+  }
+  else
+  {
+    ret = MHD_queue_response (connection, MHD_HTTP_OK, response);
+    stat = RS_PROCESSED;
+  }
+  unlock_responses ();
+  if (0 == http_threads)
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Received request for our hostlist\n"));
+  count_request (RS_PROCESSED);
+  if (RS_PROCESSED != stat)
+    count_request (stat);
+  return ret;
 }
 
 
@@ -573,38 +1090,39 @@ disconnect_handler (void *cls,
  *
  * @param cls closure (not used)
  * @param peer potential peer to connect to
- * @param hello HELLO for this peer (or NULL)
- * @param err_msg NULL if successful, otherwise contains error message
+ * @param version version of the information about @a peer
+ * @param hello new addresses of this peer
  */
 static void
 process_notify (void *cls,
                 const struct GNUNET_PeerIdentity *peer,
-                const struct GNUNET_HELLO_Message *hello,
-                const char *err_msg)
+                uint32_t version,
+                const struct GNUNET_HELLO_Message *hello)
 {
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Peerinfo is notifying us to rebuild our hostlist\n");
-  if (NULL != err_msg)
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                _("Error in communication with PEERINFO service: %s\n"),
-		err_msg);
-  if (NULL != builder)
-  {
-    /* restart re-build already in progress ... */
-    if (NULL != builder->pitr)
-    {
-      GNUNET_PEERINFO_iterate_cancel (builder->pitr);
-      builder->pitr = NULL;
-    }
-    GNUNET_free_non_null (builder->data);
-    builder->size = 0;
-    builder->data = NULL;
-  }
-  else
-  {
-    builder = GNUNET_new (struct HostSet);
-  }
+  schedule_rebuild ();
+}
+
+
+/**
+ * Start building a new hostlist response.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+start_rebuild (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  rebuild_task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  GNUNET_assert (NULL == builder);
   GNUNET_assert (NULL != peerinfo);
+  rebuild_pending = GNUNET_NO;
+  last_build = GNUNET_TIME_absolute_get ();
+  builder = GNUNET_new (struct HostSet);
   builder->pitr
     = GNUNET_PEERINFO_iterate (peerinfo,
                                GNUNET_NO, NULL,
@@ -613,6 +1131,35 @@ process_notify (void *cls,
 }
 
 
+/**
+ * Schedule a rebuild of the hostlist response, at most once
+ * per #HOSTLIST_REBUILD_FREQ.
+ */
+static void
+schedule_rebuild ()
+{
+  struct GNUNET_TIME_Relative delay;
+
+  if (NULL != builder)
+  {
+    /* build in progress, do another one once it is done */
+    rebuild_pending = GNUNET_YES;
+    return;
+  }
+  if (NULL != rebuild_task)
+    return;
+  if (NULL == response)
+    delay = HOSTLIST_INITIAL_BUILD_DELAY;
+  else
+    delay = GNUNET_TIME_absolute_get_remaining
+      (GNUNET_TIME_absolute_add (last_build,
+                                 HOSTLIST_REBUILD_FREQ));
+  rebuild_task = GNUNET_SCHEDULER_add_delayed (delay,
+                                               &start_rebuild,
+                                               NULL);
+}
+
+
 /**
  * Function that queries MHD's select sets and
  * starts the task waiting for them.
@@ -693,6 +1240,57 @@ prepare_daemon (struct MHD_Daemon *daemon_handle)
 }
 
 
+/**
+ * Start an HTTP server for our hostlist.  If #http_threads is
+ * non-zero, MHD serves requests with a pool of that many threads,
+ * otherwise it is driven by our scheduler.
+ *
+ * @param flags MHD flags for the address family
+ * @param port port to listen on
+ * @param sa address to bind to, NULL for any
+ * @return the daemon, NULL on error
+ */
+static struct MHD_Daemon *
+start_daemon (unsigned int flags,
+              uint16_t port,
+              const struct sockaddr *sa)
+{
+  if (0 != http_threads)
+    return MHD_start_daemon (flags | MHD_USE_SELECT_INTERNALLY,
+                             port,
+                             &accept_policy_callback, NULL,
+                             &access_handler_callback, NULL,
+                             MHD_OPTION_THREAD_POOL_SIZE,
+                             http_threads,
+                             MHD_OPTION_CONNECTION_LIMIT,
+                             (unsigned int) (128 * http_threads),
+                             MHD_OPTION_PER_IP_CONNECTION_LIMIT,
+                             (unsigned int) 32,
+                             MHD_OPTION_CONNECTION_TIMEOUT,
+                             (unsigned int) 16,
+                             MHD_OPTION_CONNECTION_MEMORY_LIMIT,
+                             (size_t) (16 * 1024),
+                             MHD_OPTION_SOCK_ADDR,
+                             sa,
+                             MHD_OPTION_END);
+  return MHD_start_daemon (flags,
+                           port,
+                           &accept_policy_callback, NULL,
+                           &access_handler_callback, NULL,
+                           MHD_OPTION_CONNECTION_LIMIT,
+                           (unsigned int) 128,
+                           MHD_OPTION_PER_IP_CONNECTION_LIMIT,
+                           (unsigned int) 32,
+                           MHD_OPTION_CONNECTION_TIMEOUT,
+                           (unsigned int) 16,
+                           MHD_OPTION_CONNECTION_MEMORY_LIMIT,
+                           (size_t) (16 * 1024),
+                           MHD_OPTION_SOCK_ADDR,
+                           sa,
+                           MHD_OPTION_END);
+}
+
+
 /**
  * Start server offering our hostlist.
  *
@@ -723,6 +1321,7 @@ GNUNET_HOSTLIST_server_start (const struct GNUNET_CONFIGURATION_Handle *c,
   struct sockaddr_in6 v6;
   const struct sockaddr *sa4;
   const struct sockaddr *sa6;
+  unsigned long long threads;
 
   advertising = advertise;
   if (! advertising)
@@ -854,36 +1453,42 @@ GNUNET_HOSTLIST_server_start (const struct GNUNET_CONFIGURATION_Handle *c,
     GNUNET_free (ipv6);
   }
 
-  daemon_handle_v6 = MHD_start_daemon (MHD_USE_IPv6 | MHD_USE_DEBUG,
-                                       (uint16_t) port,
-                                       &accept_policy_callback, NULL,
-                                       &access_handler_callback, NULL,
-                                       MHD_OPTION_CONNECTION_LIMIT,
-                                       (unsigned int) 128,
-                                       MHD_OPTION_PER_IP_CONNECTION_LIMIT,
-                                       (unsigned int) 32,
-                                       MHD_OPTION_CONNECTION_TIMEOUT,
-                                       (unsigned int) 16,
-                                       MHD_OPTION_CONNECTION_MEMORY_LIMIT,
-                                       (size_t) (16 * 1024),
-                                       MHD_OPTION_SOCK_ADDR,
-                                       sa6,
-                                       MHD_OPTION_END);
-  daemon_handle_v4 = MHD_start_daemon (MHD_NO_FLAG | MHD_USE_DEBUG,
-				       (uint16_t) port,
-                                       &accept_policy_callback, NULL,
-                                       &access_handler_callback, NULL,
-                                       MHD_OPTION_CONNECTION_LIMIT,
-                                       (unsigned int) 128,
-                                       MHD_OPTION_PER_IP_CONNECTION_LIMIT,
-                                       (unsigned int) 32,
-                                       MHD_OPTION_CONNECTION_TIMEOUT,
-                                       (unsigned int) 16,
-                                       MHD_OPTION_CONNECTION_MEMORY_LIMIT,
-                                       (size_t) (16 * 1024),
-                                       MHD_OPTION_SOCK_ADDR,
-                                       sa4,
-                                       MHD_OPTION_END);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "HOSTLIST",
+                                             "HTTP_THREADS",
+                                             &threads))
+    threads = 0;
+#if ! HAVE_PTHREAD
+  if (0 != threads)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("No thread support, ignoring HTTP_THREADS\n"));
+    threads = 0;
+  }
+#endif
+  if (threads > HOSTLIST_MAX_HTTP_THREADS)
+    threads = HOSTLIST_MAX_HTTP_THREADS;
+  http_threads = (unsigned int) threads;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "HOSTLIST",
+                                               "RESPONSE_FILE",
+                                               &response_file))
+    response_file = NULL;
+  else if (GNUNET_OK !=
+           GNUNET_DISK_directory_create_for_file (response_file))
+  {
+    GNUNET_free (response_file);
+    response_file = NULL;
+  }
+
+  daemon_handle_v6 = start_daemon (MHD_USE_IPv6 | MHD_USE_DEBUG,
+                                   (uint16_t) port,
+                                   sa6);
+  daemon_handle_v4 = start_daemon (MHD_NO_FLAG | MHD_USE_DEBUG,
+                                   (uint16_t) port,
+                                   sa4);
 
   if ( (NULL == daemon_handle_v6) &&
        (NULL == daemon_handle_v4) )
@@ -897,13 +1502,27 @@ GNUNET_HOSTLIST_server_start (const struct GNUNET_CONFIGURATION_Handle *c,
   core = co;
   *server_ch = &connect_handler;
   *server_dh = &disconnect_handler;
-  if (NULL != daemon_handle_v4)
-    hostlist_task_v4 = prepare_daemon (daemon_handle_v4);
-  if (NULL != daemon_handle_v6)
-    hostlist_task_v6 = prepare_daemon (daemon_handle_v6);
-  notify = GNUNET_PEERINFO_notify (cfg,
-                                   GNUNET_NO,
-                                   &process_notify, NULL);
+  if (0 == http_threads)
+  {
+    if (NULL != daemon_handle_v4)
+      hostlist_task_v4 = prepare_daemon (daemon_handle_v4);
+    if (NULL != daemon_handle_v6)
+      hostlist_task_v6 = prepare_daemon (daemon_handle_v6);
+  }
+  else
+  {
+    stats_task = GNUNET_SCHEDULER_add_delayed (HOSTLIST_STATS_FREQ,
+                                               &report_request_stats,
+                                               NULL);
+  }
+  /* build the initial response even if no peer has addresses */
+  schedule_rebuild ();
+  /* only peers gaining addresses change our hostlist */
+  notify = GNUNET_PEERINFO_notify_filtered (cfg,
+                                            GNUNET_PEERINFO_NOTIFY_OPTION_HAS_ADDRESSES |
+                                            GNUNET_PEERINFO_NOTIFY_OPTION_DELTA,
+                                            NULL,
+                                            &process_notify, NULL);
   return GNUNET_OK;
 }
 
@@ -941,6 +1560,30 @@ GNUNET_HOSTLIST_server_stop ()
     MHD_destroy_response (response);
     response = NULL;
   }
+  if (NULL != response_gzip)
+  {
+    MHD_destroy_response (response_gzip);
+    response_gzip = NULL;
+  }
+  if (NULL != response_not_modified)
+  {
+    MHD_destroy_response (response_not_modified);
+    response_not_modified = NULL;
+  }
+  if (NULL != stats_task)
+  {
+    GNUNET_SCHEDULER_cancel (stats_task);
+    stats_task = NULL;
+    report_request_stats (NULL, NULL);
+  }
+  if (NULL != rebuild_task)
+  {
+    GNUNET_SCHEDULER_cancel (rebuild_task);
+    rebuild_task = NULL;
+  }
+  rebuild_pending = GNUNET_NO;
+  GNUNET_free_non_null (response_file);
+  response_file = NULL;
   if (NULL != notify)
   {
     GNUNET_PEERINFO_notify_cancel (notify);
@@ -955,6 +1598,7 @@ GNUNET_HOSTLIST_server_stop ()
     }
     GNUNET_free_non_null (builder->data);
     GNUNET_free (builder);
+    builder = NULL;
   }
   if (NULL != peerinfo)
   {
@@ -109,6 +109,149 @@ static struct Ego *ego_head;
  */
 static struct Ego *ego_tail;
 
+/**
+ * Map from the hash of the identifier to the `struct Ego`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *ego_by_name;
+
+/**
+ * Map from the hash of the private key to the `struct Ego`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *ego_by_key;
+
+
+/**
+ * Add the identifier of an ego to the name index.
+ *
+ * @param ego ego to add
+ */
+static void
+ego_add_name (struct Ego *ego)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (ego->identifier,
+		      strlen (ego->identifier),
+		      &key);
+  GNUNET_break (GNUNET_OK ==
+		GNUNET_CONTAINER_multihashmap_put (ego_by_name,
+						   &key,
+						   ego,
+						   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+}
+
+
+/**
+ * Add an ego to the list of egos and to the indices.
+ *
+ * @param ego ego to add, must have an identifier
+ */
+static void
+ego_add (struct Ego *ego)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CONTAINER_DLL_insert (ego_head,
+			       ego_tail,
+			       ego);
+  ego_add_name (ego);
+  GNUNET_CRYPTO_hash (ego->pk,
+		      sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
+		      &key);
+  (void) GNUNET_CONTAINER_multihashmap_put (ego_by_key,
+					    &key,
+					    ego,
+					    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+}
+
+
+/**
+ * Remove the identifier of an ego from the name index.
+ *
+ * @param ego ego to remove
+ */
+static void
+ego_remove_name (struct Ego *ego)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (ego->identifier,
+		      strlen (ego->identifier),
+		      &key);
+  GNUNET_break (GNUNET_YES ==
+		GNUNET_CONTAINER_multihashmap_remove (ego_by_name,
+						      &key,
+						      ego));
+}
+
+
+/**
+ * Remove an ego from the list of egos and from the indices.
+ *
+ * @param ego ego to remove
+ */
+static void
+ego_remove (struct Ego *ego)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CONTAINER_DLL_remove (ego_head,
+			       ego_tail,
+			       ego);
+  ego_remove_name (ego);
+  GNUNET_CRYPTO_hash (ego->pk,
+		      sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
+		      &key);
+  GNUNET_break (GNUNET_YES ==
+		GNUNET_CONTAINER_multihashmap_remove (ego_by_key,
+						      &key,
+						      ego));
+}
+
+
+/**
+ * Find an ego by its identifier.
+ *
+ * @param identifier name of the ego
+ * @return NULL if no such ego exists
+ */
+static struct Ego *
+find_ego_by_name (const char *identifier)
+{
+  struct GNUNET_HashCode key;
+  struct Ego *ego;
+
+  GNUNET_CRYPTO_hash (identifier,
+		      strlen (identifier),
+		      &key);
+  ego = GNUNET_CONTAINER_multihashmap_get (ego_by_name,
+					   &key);
+  if ( (NULL != ego) &&
+       (0 != strcmp (ego->identifier,
+		     identifier)) )
+    return NULL; /* hash collision */
+  return ego;
+}
+
+
+/**
+ * Find an ego by its private key.
+ *
+ * @param pk private key of the ego
+ * @return NULL if no such ego exists
+ */
+static struct Ego *
+find_ego_by_key (const struct GNUNET_CRYPTO_EcdsaPrivateKey *pk)
+{
+  struct GNUNET_HashCode key;
+
+  GNUNET_CRYPTO_hash (pk,
+		      sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
+		      &key);
+  return GNUNET_CONTAINER_multihashmap_get (ego_by_key,
+					    &key);
+}
+
 
 /**
  * Get the name of the file we use to store a given ego.
@@ -159,11 +302,21 @@ shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   ego_directory = NULL;
   while (NULL != (e = ego_head))
   {
-    GNUNET_CONTAINER_DLL_remove (ego_head, ego_tail, e);
+    ego_remove (e);
     GNUNET_free (e->pk);
     GNUNET_free (e->identifier);
     GNUNET_free (e);
   }
+  if (NULL != ego_by_name)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (ego_by_name);
+    ego_by_name = NULL;
+  }
+  if (NULL != ego_by_key)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (ego_by_key);
+    ego_by_key = NULL;
+  }
 }
 
 
@@ -339,20 +492,17 @@ handle_get_default_message (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_SERVER_receive_done (client, GNUNET_OK);
     return;
   }
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  ego = find_ego_by_name (identifier);
+  if (NULL != ego)
   {
-    if (0 == strcmp (ego->identifier,
-		     identifier))
-    {
-      sdm = create_set_default_message (ego,
-					name);
-      GNUNET_SERVER_notification_context_unicast (nc, client,
-                                                  &sdm->header, GNUNET_NO);
-      GNUNET_free (sdm);
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      GNUNET_free (identifier);
-      return;
-    }
+    sdm = create_set_default_message (ego,
+				      name);
+    GNUNET_SERVER_notification_context_unicast (nc, client,
+						&sdm->header, GNUNET_NO);
+    GNUNET_free (sdm);
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    GNUNET_free (identifier);
+    return;
   }
   GNUNET_free (identifier);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -423,25 +573,24 @@ handle_set_default_message (void *cls, struct GNUNET_SERVER_Client *client,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received SET_DEFAULT for service `%s' from client\n",
 	      str);
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  ego = find_ego_by_key (&sdm->private_key);
+  if ( (NULL != ego) &&
+       (0 == key_cmp (ego->pk,
+		      &sdm->private_key)) )
   {
-    if (0 == key_cmp (ego->pk,
-		      &sdm->private_key))
-    {
-      GNUNET_CONFIGURATION_set_value_string (subsystem_cfg,
-					     str,
-					     "DEFAULT_IDENTIFIER",
-					     ego->identifier);
-      if (GNUNET_OK !=
-	  GNUNET_CONFIGURATION_write (subsystem_cfg,
-				      subsystem_cfg_file))
-	GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		    _("Failed to write subsystem default identifier map to `%s'.\n"),
-		    subsystem_cfg_file);
-      send_result_code (client, 0, NULL);
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      return;
-    }
+    GNUNET_CONFIGURATION_set_value_string (subsystem_cfg,
+					   str,
+					   "DEFAULT_IDENTIFIER",
+					   ego->identifier);
+    if (GNUNET_OK !=
+	GNUNET_CONFIGURATION_write (subsystem_cfg,
+				    subsystem_cfg_file))
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		  _("Failed to write subsystem default identifier map to `%s'.\n"),
+		  subsystem_cfg_file);
+    send_result_code (client, 0, NULL);
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
   }
   send_result_code (client, 1, _("Unknown ego specified for service (internal error)"));
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
@@ -508,23 +657,17 @@ handle_create_message (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     return;
   }
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  if (NULL != find_ego_by_name (str))
   {
-    if (0 == strcmp (ego->identifier,
-		     str))
-    {
-      send_result_code (client, 1, gettext_noop ("identifier already in use for another ego"));
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      return;
-    }
+    send_result_code (client, 1, gettext_noop ("identifier already in use for another ego"));
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
   }
   ego = GNUNET_new (struct Ego);
   ego->pk = GNUNET_new (struct GNUNET_CRYPTO_EcdsaPrivateKey);
   *ego->pk = crm->private_key;
   ego->identifier = GNUNET_strdup (str);
-  GNUNET_CONTAINER_DLL_insert (ego_head,
-			       ego_tail,
-			       ego);
+  ego_add (ego);
   send_result_code (client, 0, NULL);
   fn = get_ego_filename (ego);
   (void) GNUNET_DISK_directory_create_for_file (fn);
@@ -639,51 +782,44 @@ handle_rename_message (void *cls, struct GNUNET_SERVER_Client *client,
   }
 
   /* check if new name is already in use */
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  if (NULL != find_ego_by_name (new_name))
   {
-    if (0 == strcmp (ego->identifier,
-		     new_name))
-    {
-      send_result_code (client, 1, gettext_noop ("target name already exists"));
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      return;
-    }
+    send_result_code (client, 1, gettext_noop ("target name already exists"));
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
   }
 
   /* locate old name and, if found, perform rename */
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  ego = find_ego_by_name (old_name);
+  if (NULL == ego)
   {
-    if (0 == strcmp (ego->identifier,
-		     old_name))
-    {
-      fn_old = get_ego_filename (ego);
-      GNUNET_free (ego->identifier);
-      rename_ctx.old_name = old_name;
-      rename_ctx.new_name = new_name;
-      GNUNET_CONFIGURATION_iterate_sections (subsystem_cfg,
-					     &handle_ego_rename,
-					     &rename_ctx);
-      if (GNUNET_OK !=
-	  GNUNET_CONFIGURATION_write (subsystem_cfg,
-				      subsystem_cfg_file))
-	GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		    _("Failed to write subsystem default identifier map to `%s'.\n"),
-		    subsystem_cfg_file);
-      ego->identifier = GNUNET_strdup (new_name);
-      fn_new = get_ego_filename (ego);
-      if (0 != RENAME (fn_old, fn_new))
-	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "rename", fn_old);
-      GNUNET_free (fn_old);
-      GNUNET_free (fn_new);
-      notify_listeners (ego);
-      send_result_code (client, 0, NULL);
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      return;
-    }
-  }
-
-  /* failed to locate old name */
-  send_result_code (client, 1, gettext_noop ("no matching ego found"));
+    send_result_code (client, 1, gettext_noop ("no matching ego found"));
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
+  fn_old = get_ego_filename (ego);
+  ego_remove_name (ego);
+  GNUNET_free (ego->identifier);
+  rename_ctx.old_name = old_name;
+  rename_ctx.new_name = new_name;
+  GNUNET_CONFIGURATION_iterate_sections (subsystem_cfg,
+					 &handle_ego_rename,
+					 &rename_ctx);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_write (subsystem_cfg,
+				  subsystem_cfg_file))
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Failed to write subsystem default identifier map to `%s'.\n"),
+		subsystem_cfg_file);
+  ego->identifier = GNUNET_strdup (new_name);
+  ego_add_name (ego);
+  fn_new = get_ego_filename (ego);
+  if (0 != RENAME (fn_old, fn_new))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "rename", fn_old);
+  GNUNET_free (fn_old);
+  GNUNET_free (fn_new);
+  notify_listeners (ego);
+  send_result_code (client, 0, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -760,39 +896,84 @@ handle_delete_message (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     return;
   }
-  for (ego = ego_head; NULL != ego; ego = ego->next)
+  ego = find_ego_by_name (name);
+  if (NULL == ego)
   {
-    if (0 == strcmp (ego->identifier,
-		     name))
-    {
-      GNUNET_CONTAINER_DLL_remove (ego_head,
-				   ego_tail,
-				   ego);
-      GNUNET_CONFIGURATION_iterate_sections (subsystem_cfg,
-					     &handle_ego_delete,
-					     ego->identifier);
-      if (GNUNET_OK !=
-	  GNUNET_CONFIGURATION_write (subsystem_cfg,
-				      subsystem_cfg_file))
-	GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		    _("Failed to write subsystem default identifier map to `%s'.\n"),
-		    subsystem_cfg_file);
-      fn = get_ego_filename (ego);
-      if (0 != UNLINK (fn))
-	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "unlink", fn);
-      GNUNET_free (fn);
-      GNUNET_free (ego->identifier);
-      ego->identifier = NULL;
-      notify_listeners (ego);
-      GNUNET_free (ego->pk);
-      GNUNET_free (ego);
-      send_result_code (client, 0, NULL);
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      return;
-    }
-  }
-
-  send_result_code (client, 1, gettext_noop ("no matching ego found"));
+    send_result_code (client, 1, gettext_noop ("no matching ego found"));
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
+  ego_remove (ego);
+  GNUNET_CONFIGURATION_iterate_sections (subsystem_cfg,
+					 &handle_ego_delete,
+					 ego->identifier);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_write (subsystem_cfg,
+				  subsystem_cfg_file))
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+		_("Failed to write subsystem default identifier map to `%s'.\n"),
+		subsystem_cfg_file);
+  fn = get_ego_filename (ego);
+  if (0 != UNLINK (fn))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "unlink", fn);
+  GNUNET_free (fn);
+  GNUNET_free (ego->identifier);
+  ego->identifier = NULL;
+  notify_listeners (ego);
+  GNUNET_free (ego->pk);
+  GNUNET_free (ego);
+  send_result_code (client, 0, NULL);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
+/**
+ * Handler for LOOKUP message from client, returns the
+ * ego with the given name.
+ *
+ * @param cls unused
+ * @param client who sent the message
+ * @param message the message received
+ */
+static void
+handle_lookup_message (void *cls, struct GNUNET_SERVER_Client *client,
+		       const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_IDENTITY_LookupMessage *lm;
+  struct GNUNET_IDENTITY_UpdateMessage *um;
+  uint16_t size;
+  struct Ego *ego;
+  const char *name;
+
+  size = ntohs (message->size);
+  if (size <= sizeof (struct GNUNET_IDENTITY_LookupMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  lm = (const struct GNUNET_IDENTITY_LookupMessage *) message;
+  name = (const char *) &lm[1];
+  if ('\0' != name[size - sizeof (struct GNUNET_IDENTITY_LookupMessage) - 1])
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Received LOOKUP for ego `%s' from client\n",
+	      name);
+  GNUNET_SERVER_notification_context_add (nc, client);
+  ego = find_ego_by_name (name);
+  if (NULL == ego)
+  {
+    send_result_code (client, 1, gettext_noop ("no matching ego found"));
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
+  um = create_update_message (ego);
+  GNUNET_SERVER_notification_context_unicast (nc, client, &um->header, GNUNET_NO);
+  GNUNET_free (um);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -834,9 +1015,7 @@ process_ego_file (void *cls,
 	      "Loaded ego `%s'\n",
 	      fn + 1);
   ego->identifier = GNUNET_strdup (fn + 1);
-  GNUNET_CONTAINER_DLL_insert (ego_head,
-			       ego_tail,
-			       ego);
+  ego_add (ego);
   return GNUNET_OK;
 }
 
@@ -866,6 +1045,8 @@ run (void *cls,
      GNUNET_MESSAGE_TYPE_IDENTITY_RENAME, 0},
     {&handle_delete_message, NULL,
      GNUNET_MESSAGE_TYPE_IDENTITY_DELETE, 0},
+    {&handle_lookup_message, NULL,
+     GNUNET_MESSAGE_TYPE_IDENTITY_LOOKUP, 0},
     {NULL, NULL, 0, 0}
   };
 
@@ -905,6 +1086,8 @@ run (void *cls,
     return;
   }
   stats = GNUNET_STATISTICS_create ("identity", cfg);
+  ego_by_name = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
+  ego_by_key = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
   GNUNET_SERVER_add_handlers (server, handlers);
   nc = GNUNET_SERVER_notification_context_create (server, 1);
   if (GNUNET_OK !=
@@ -230,7 +230,52 @@ struct GNUNET_IDENTITY_DeleteMessage
 };
 
 
+/**
+ * Client requests information about a single ego.  Service
+ * answers with an update message for the ego, or with a
+ * result code if no such ego exists.
+ */
+struct GNUNET_IDENTITY_LookupMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_IDENTITY_LOOKUP
+   */
+  struct GNUNET_MessageHeader header;
+
+  /* followed by 0-terminated ego name */
+
+};
+
+
 
 GNUNET_NETWORK_STRUCT_END
 
+
+/**
+ * Handle for an ego.
+ */
+struct GNUNET_IDENTITY_Ego
+{
+  /**
+   * Private key associated with this ego.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey *pk;
+
+  /**
+   * Current name associated with this ego.
+   */
+  char *name;
+
+  /**
+   * Client context associated with this ego.
+   */
+  void *ctx;
+
+  /**
+   * Hash of the public key of this ego.
+   */
+  struct GNUNET_HashCode id;
+};
+
+
 #endif
@@ -25,7 +25,9 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
+#include "gnunet_protocols.h"
 #include "gnunet_identity_service.h"
+#include "identity.h"
 
 #define LOG(kind,...) GNUNET_log_from (kind, "identity-api",__VA_ARGS__)
 
@@ -37,9 +39,14 @@ struct GNUNET_IDENTITY_EgoLookup
 {
 
   /**
-   * Handle to the identity service.
+   * Connection to the identity service.
    */
-  struct GNUNET_IDENTITY_Handle *identity;
+  struct GNUNET_CLIENT_Connection *client;
+
+  /**
+   * Pending transmission of our LOOKUP request, or NULL.
+   */
+  struct GNUNET_CLIENT_TransmitHandle *th;
 
   /**
    * Name of the ego we are looking up.
@@ -59,53 +66,111 @@ struct GNUNET_IDENTITY_EgoLookup
 
 
 /**
- * Method called to inform about the egos of this peer.
- *
- * When used with #GNUNET_IDENTITY_connect, this function is
- * initially called for all egos and then again whenever a
- * ego's name changes or if it is deleted.  At the end of
- * the initial pass over all egos, the function is once called
- * with 'NULL' for @a ego. That does NOT mean that the callback won't
- * be invoked in the future or that there was an error.
- *
- * If the @a name matches the name from @a cls, we found the zone
- * for our computation and will invoke the callback.
- * If we have iterated over all egos and not found the name, we
- * invoke the callback with NULL.
+ * Handle a response from the identity service.  The service answers
+ * with an update message for the ego, or with a result code if the
+ * ego does not exist.  Updates for other egos may be broadcast to us
+ * before the answer arrives; we skip those.
  *
  * @param cls closure with the `struct GNUNET_IDENTITY_EgoLookup`
- * @param ego ego handle
- * @param ctx context for application to store data for this ego
- *                 (during the lifetime of this process, initially NULL)
- * @param name name assigned by the user for this ego,
- *                   NULL if the user just deleted the ego and it
- *                   must thus no longer be used
+ * @param msg message received, NULL on timeout or fatal error
  */
 static void
-identity_cb (void *cls,
-	     struct GNUNET_IDENTITY_Ego *ego,
-	     void **ctx,
-	     const char *name)
+handle_lookup_response (void *cls,
+                        const struct GNUNET_MessageHeader *msg)
 {
   struct GNUNET_IDENTITY_EgoLookup *el = cls;
-
-  if ( (NULL != name) &&
-       (0 == strcmp (name,
-		     el->name)) )
+  const struct GNUNET_IDENTITY_UpdateMessage *um;
+  struct GNUNET_IDENTITY_Ego ego;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey pk;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pub;
+  const char *str;
+  uint16_t size;
+  uint16_t name_len;
+
+  if ( (NULL == msg) ||
+       (GNUNET_MESSAGE_TYPE_IDENTITY_RESULT_CODE == ntohs (msg->type)) )
   {
+    /* not found, or the service is gone */
     el->cb (el->cb_cls,
-	    ego);
+	    NULL);
     GNUNET_IDENTITY_ego_lookup_cancel (el);
     return;
   }
-  if (NULL == ego)
+  size = ntohs (msg->size);
+  if ( (GNUNET_MESSAGE_TYPE_IDENTITY_UPDATE != ntohs (msg->type)) ||
+       (size < sizeof (struct GNUNET_IDENTITY_UpdateMessage)) )
   {
-    /* not found */
+    GNUNET_break (0);
     el->cb (el->cb_cls,
 	    NULL);
     GNUNET_IDENTITY_ego_lookup_cancel (el);
     return;
   }
+  um = (const struct GNUNET_IDENTITY_UpdateMessage *) msg;
+  name_len = ntohs (um->name_len);
+  str = (const char *) &um[1];
+  if ( (size != name_len + sizeof (struct GNUNET_IDENTITY_UpdateMessage)) ||
+       (0 == name_len) ||
+       ('\0' != str[name_len - 1]) ||
+       (0 != strcmp (str,
+		     el->name)) )
+  {
+    /* broadcast about some other ego */
+    GNUNET_CLIENT_receive (el->client,
+			   &handle_lookup_response, el,
+			   GNUNET_TIME_UNIT_FOREVER_REL);
+    return;
+  }
+  pk = um->private_key;
+  memset (&ego, 0, sizeof (ego));
+  ego.pk = &pk;
+  ego.name = el->name;
+  GNUNET_CRYPTO_ecdsa_key_get_public (&pk,
+				      &pub);
+  GNUNET_CRYPTO_hash (&pub, sizeof (pub), &ego.id);
+  el->cb (el->cb_cls,
+	  &ego);
+  GNUNET_IDENTITY_ego_lookup_cancel (el);
+}
+
+
+/**
+ * Transmit our LOOKUP request to the identity service.
+ *
+ * @param cls closure with the `struct GNUNET_IDENTITY_EgoLookup`
+ * @param size number of bytes available in @a buf
+ * @param buf where to copy the message, NULL on error
+ * @return number of bytes written to @a buf
+ */
+static size_t
+send_lookup (void *cls,
+	     size_t size,
+	     void *buf)
+{
+  struct GNUNET_IDENTITY_EgoLookup *el = cls;
+  struct GNUNET_IDENTITY_LookupMessage lm;
+  size_t name_len;
+
+  el->th = NULL;
+  if (NULL == buf)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+	 "Failed to send ego lookup to identity service\n");
+    el->cb (el->cb_cls,
+	    NULL);
+    GNUNET_IDENTITY_ego_lookup_cancel (el);
+    return 0;
+  }
+  name_len = strlen (el->name) + 1;
+  GNUNET_assert (size >= sizeof (lm) + name_len);
+  lm.header.type = htons (GNUNET_MESSAGE_TYPE_IDENTITY_LOOKUP);
+  lm.header.size = htons (sizeof (lm) + name_len);
+  memcpy (buf, &lm, sizeof (lm));
+  memcpy ((char *) buf + sizeof (lm), el->name, name_len);
+  GNUNET_CLIENT_receive (el->client,
+			 &handle_lookup_response, el,
+			 GNUNET_TIME_UNIT_FOREVER_REL);
+  return sizeof (lm) + name_len;
 }
 
 
@@ -125,14 +190,31 @@ GNUNET_IDENTITY_ego_lookup (const struct GNUNET_CONFIGURATION_Handle *cfg,
 			    void *cb_cls)
 {
   struct GNUNET_IDENTITY_EgoLookup *el;
+  size_t name_len;
 
+  name_len = strlen (name) + 1;
+  if (name_len + sizeof (struct GNUNET_IDENTITY_LookupMessage) >=
+      GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
   el = GNUNET_new (struct GNUNET_IDENTITY_EgoLookup);
+  el->client = GNUNET_CLIENT_connect ("identity", cfg);
+  if (NULL == el->client)
+  {
+    GNUNET_free (el);
+    return NULL;
+  }
   el->name = GNUNET_strdup (name);
   el->cb = cb;
   el->cb_cls = cb_cls;
-  el->identity = GNUNET_IDENTITY_connect (cfg,
-					  &identity_cb,
-					  el);
+  el->th = GNUNET_CLIENT_notify_transmit_ready (el->client,
+					       sizeof (struct GNUNET_IDENTITY_LookupMessage) + name_len,
+					       GNUNET_TIME_UNIT_FOREVER_REL,
+					       GNUNET_YES,
+					       &send_lookup,
+					       el);
   return el;
 }
 
@@ -145,7 +227,9 @@ GNUNET_IDENTITY_ego_lookup (const struct GNUNET_CONFIGURATION_Handle *cfg,
 void
 GNUNET_IDENTITY_ego_lookup_cancel (struct GNUNET_IDENTITY_EgoLookup *el)
 {
-  GNUNET_IDENTITY_disconnect (el->identity);
+  if (NULL != el->th)
+    GNUNET_CLIENT_notify_transmit_ready_cancel (el->th);
+  GNUNET_CLIENT_disconnect (el->client);
   GNUNET_free (el->name);
   GNUNET_free (el);
 }
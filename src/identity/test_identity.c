@@ -47,6 +47,16 @@ static struct GNUNET_IDENTITY_Handle *h;
  */
 static struct GNUNET_IDENTITY_Operation *op;
 
+/**
+ * Handle to ego lookup.
+ */
+static struct GNUNET_IDENTITY_EgoLookup *el;
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
 /**
  * Handle for task for timeout termination.
  */
@@ -64,6 +74,11 @@ cleanup ()
     GNUNET_IDENTITY_cancel (op);
     op = NULL;
   }
+  if (NULL != el)
+  {
+    GNUNET_IDENTITY_ego_lookup_cancel (el);
+    el = NULL;
+  }
   if (NULL != h)
   {
     GNUNET_IDENTITY_disconnect (h);
@@ -203,16 +218,17 @@ fail_rename_cont (void *cls,
 
 
 /**
- * Continuation called from successful rename operation.
+ * Called with the result of looking up the renamed ego.
  *
  * @param cls NULL
- * @param emsg (should also be NULL)
+ * @param ego the ego (should not be NULL)
  */
 static void
-success_rename_cont (void *cls,
-		     const char *emsg)
+lookup_cb (void *cls,
+	   const struct GNUNET_IDENTITY_Ego *ego)
 {
-  GNUNET_assert (NULL == emsg);
+  el = NULL;
+  GNUNET_assert (NULL != ego);
   op = GNUNET_IDENTITY_rename (h,
 			       "test-id",
 			       "test",
@@ -221,6 +237,26 @@ success_rename_cont (void *cls,
 }
 
 
+/**
+ * Continuation called from successful rename operation.
+ *
+ * @param cls NULL
+ * @param emsg (should also be NULL)
+ */
+static void
+success_rename_cont (void *cls,
+		     const char *emsg)
+{
+  GNUNET_assert (NULL == emsg);
+  op = NULL;
+  el = GNUNET_IDENTITY_ego_lookup (cfg,
+				   "test",
+				   &lookup_cb,
+				   NULL);
+  GNUNET_assert (NULL != el);
+}
+
+
 /**
  * Called with events about created ego.
  *
@@ -249,9 +285,10 @@ create_cb (void *cls,
  */
 static void
 run (void *cls,
-     const struct GNUNET_CONFIGURATION_Handle *cfg,
+     const struct GNUNET_CONFIGURATION_Handle *c,
      struct GNUNET_TESTING_Peer *peer)
 {
+  cfg = c;
   endbadly_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
 						&endbadly, NULL);
   h = GNUNET_IDENTITY_connect (cfg, &notification_cb, NULL);
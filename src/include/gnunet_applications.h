@@ -55,6 +55,12 @@ extern "C"
  */
 #define GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER 3
 
+/**
+ * Transfer of blocks for non-anonymmous file-sharing, with
+ * several queries per message.
+ */
+#define GNUNET_APPLICATION_TYPE_FS_BLOCK_TRANSFER_BATCH 4
+
 /**
  * Internet IPv4 gateway (any TCP/UDP/ICMP).
  */
@@ -116,6 +122,12 @@ extern "C"
  */
 #define GNUNET_APPLICATION_TYPE_MULTICAST 26
 
+/**
+ * Scalarproduct using ECC instead of Paillier.  Separate from
+ * #GNUNET_APPLICATION_TYPE_SCALARPRODUCT as the wire protocols differ.
+ */
+#define GNUNET_APPLICATION_TYPE_SCALARPRODUCT_ECC 27
+
 
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
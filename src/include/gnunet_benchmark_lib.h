@@ -0,0 +1,162 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file include/gnunet_benchmark_lib.h
+ * @brief common harness for the perf_* programs
+ * @author Christian Grothoff
+ * @defgroup benchmark Micro-benchmark harness
+ *
+ * A suite collects any number of named benchmarks.  Each benchmark
+ * is measured over several repetitions (after some untimed warmup
+ * repetitions); when the suite is destroyed, the minimum, median,
+ * 90th and 99th percentile, maximum and mean time per repetition as
+ * well as the rate are printed, reported to gauger and, if the
+ * environment variable `GNUNET_BENCHMARK_JSON` names a file, appended
+ * to that file as one JSON object per line ("-" means stdout).
+ *
+ * `GNUNET_BENCHMARK_REPETITIONS` and `GNUNET_BENCHMARK_WARMUP`
+ * override the number of (warmup) repetitions of all benchmarks.
+ * @{
+ */
+
+#ifndef GNUNET_BENCHMARK_LIB_H
+#define GNUNET_BENCHMARK_LIB_H
+
+#include "gnunet_time_lib.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#if 0                           /* keep Emacsens' auto-indent happy */
+}
+#endif
+#endif
+
+
+/**
+ * @ingroup benchmark
+ * Handle for a suite of benchmarks.
+ */
+struct GNUNET_BENCHMARK_Suite;
+
+
+/**
+ * @ingroup benchmark
+ * Function run for each repetition of a benchmark.
+ *
+ * @param cls closure
+ * @return amount of work done (in the unit of the benchmark)
+ */
+typedef uint64_t
+(*GNUNET_BENCHMARK_Function) (void *cls);
+
+
+/**
+ * @ingroup benchmark
+ * Create a benchmark suite.
+ *
+ * @param category gauger category of the results (i.e. "UTIL")
+ * @param name name of the suite, usually the name of the program
+ * @return handle for the suite
+ */
+struct GNUNET_BENCHMARK_Suite *
+GNUNET_BENCHMARK_suite_create (const char *category,
+                               const char *name);
+
+
+/**
+ * @ingroup benchmark
+ * Run a synchronous benchmark: call @a fn for the warmup repetitions
+ * without measuring, then measure each of @a repetitions calls.
+ *
+ * @param suite suite the benchmark belongs to
+ * @param name name of the benchmark, also used as the gauger counter
+ * @param unit unit of the work returned by @a fn (i.e. "kb" or "ops")
+ * @param repetitions default number of measured repetitions
+ * @param fn function doing the work of one repetition
+ * @param fn_cls closure for @a fn
+ */
+void
+GNUNET_BENCHMARK_run (struct GNUNET_BENCHMARK_Suite *suite,
+                      const char *name,
+                      const char *unit,
+                      unsigned int repetitions,
+                      GNUNET_BENCHMARK_Function fn,
+                      void *fn_cls);
+
+
+/**
+ * @ingroup benchmark
+ * Add one measured repetition of a benchmark.  Used for asynchronous
+ * benchmarks that cannot be wrapped in a #GNUNET_BENCHMARK_Function;
+ * calling this several times with the same @a name adds repetitions.
+ *
+ * @param suite suite the benchmark belongs to
+ * @param name name of the benchmark, also used as the gauger counter
+ * @param unit unit of @a work (i.e. "kb" or "ops")
+ * @param duration time the repetition took
+ * @param work amount of work done in the repetition
+ */
+void
+GNUNET_BENCHMARK_report (struct GNUNET_BENCHMARK_Suite *suite,
+                         const char *name,
+                         const char *unit,
+                         struct GNUNET_TIME_Relative duration,
+                         uint64_t work);
+
+
+/**
+ * @ingroup benchmark
+ * Number of measured repetitions asynchronous benchmarks should do,
+ * taking `GNUNET_BENCHMARK_REPETITIONS` into account.
+ *
+ * @param repetitions default number of repetitions
+ * @return number of repetitions to do
+ */
+unsigned int
+GNUNET_BENCHMARK_get_repetitions (unsigned int repetitions);
+
+
+/**
+ * @ingroup benchmark
+ * Summarize and output the results of all benchmarks of a suite,
+ * then free it.
+ *
+ * @param suite suite to finish
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the JSON
+ *         output could not be written
+ */
+int
+GNUNET_BENCHMARK_suite_destroy (struct GNUNET_BENCHMARK_Suite *suite);
+
+
+#if 0                           /* keep Emacsens' auto-indent happy */
+{
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+/** @} */ /* end of group benchmark */
+
+/* ifndef GNUNET_BENCHMARK_LIB_H */
+#endif
+/* end of gnunet_benchmark_lib.h */
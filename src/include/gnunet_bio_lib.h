@@ -97,6 +97,25 @@ GNUNET_BIO_read_fn (struct GNUNET_BIO_ReadHandle *h,
                     const char *file, int line,
                     void *result, size_t len);
 
+
+/**
+ * Read @a len bytes from a file without copying them into a buffer
+ * of the caller.  If the file is mapped into memory, @a result
+ * points into the mapping; otherwise it points into a buffer of
+ * the handle.
+ *
+ * @param h handle to an open file
+ * @param what describes what is being read (for error message creation)
+ * @param result set to the data read, valid until the next read
+ *        from @a h or until it is closed
+ * @param len the number of bytes to read
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on failure
+ */
+int
+GNUNET_BIO_read_span (struct GNUNET_BIO_ReadHandle *h, const char *what,
+                      const void **result, size_t len);
+
+
 /**
  * Read 0-terminated string from a file.
  *
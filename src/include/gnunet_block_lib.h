@@ -256,6 +256,41 @@ GNUNET_BLOCK_evaluate (struct GNUNET_BLOCK_Context *ctx,
                        size_t reply_block_size);
 
 
+/**
+ * Validate several replies to the same query at once.  Equivalent to
+ * calling #GNUNET_BLOCK_evaluate() for each reply in order (so
+ * duplicates within the batch are detected via @a bf), but looks up
+ * the plugin only once.
+ *
+ * @param ctx block contxt
+ * @param type block type
+ * @param eo evaluation options to control evaluation
+ * @param query original query (hash)
+ * @param bf pointer to bloom filter associated with query; possibly updated (!)
+ * @param bf_mutator mutation value for @a bf
+ * @param xquery extrended query data (can be NULL, depending on type)
+ * @param xquery_size number of bytes in @a xquery
+ * @param reply_count number of replies to validate
+ * @param reply_blocks array of @a reply_count responses to validate
+ * @param reply_block_sizes number of bytes in each of the @a reply_blocks
+ * @param results array of @a reply_count entries, set to the
+ *        characterization of each reply
+ */
+void
+GNUNET_BLOCK_evaluate_batch (struct GNUNET_BLOCK_Context *ctx,
+                             enum GNUNET_BLOCK_Type type,
+                             enum GNUNET_BLOCK_EvaluationOptions eo,
+                             const struct GNUNET_HashCode *query,
+                             struct GNUNET_CONTAINER_BloomFilter **bf,
+                             int32_t bf_mutator,
+                             const void *xquery,
+                             size_t xquery_size,
+                             unsigned int reply_count,
+                             const void *const *reply_blocks,
+                             const size_t *reply_block_sizes,
+                             enum GNUNET_BLOCK_EvaluationResult *results);
+
+
 /**
  * Function called to obtain the key for a block.
  *
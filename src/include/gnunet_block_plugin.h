@@ -87,6 +87,77 @@ typedef int
 
 
 
+/**
+ * Check the hash of a reply against the reply bloom filter of a
+ * request and add it, creating the filter if necessary.  This is
+ * what most plugins do after they validated a reply.
+ *
+ * @param bf pointer to bloom filter associated with the query, can be NULL
+ * @param bf_mutator mutation value for @a bf
+ * @param reply_hash hash identifying the reply (usually of the whole block)
+ * @return #GNUNET_YES if the reply is a duplicate, #GNUNET_NO if not
+ */
+int
+GNUNET_BLOCK_check_reply_filter (struct GNUNET_CONTAINER_BloomFilter **bf,
+                                 int32_t bf_mutator,
+                                 const struct GNUNET_HashCode *reply_hash);
+
+
+/**
+ * Small cache of recent verification results, for plugins whose
+ * replies are expensive to verify (i.e. signed blocks).  The same
+ * block often reaches us via several routes; with the cache, its
+ * signature is only checked once.
+ */
+struct GNUNET_BLOCK_VerificationCache;
+
+
+/**
+ * Create a verification cache.
+ *
+ * @param size number of results to remember
+ * @return the cache
+ */
+struct GNUNET_BLOCK_VerificationCache *
+GNUNET_BLOCK_verification_cache_create (unsigned int size);
+
+
+/**
+ * Destroy a verification cache.
+ *
+ * @param cache cache to destroy
+ */
+void
+GNUNET_BLOCK_verification_cache_destroy (struct GNUNET_BLOCK_VerificationCache *cache);
+
+
+/**
+ * Look up the result of verifying a block.
+ *
+ * @param cache cache to use
+ * @param block_hash hash of the complete block (including its signature)
+ * @return #GNUNET_OK if the block is known to be valid,
+ *         #GNUNET_SYSERR if it is known to be invalid,
+ *         #GNUNET_NO if we did not verify it recently
+ */
+int
+GNUNET_BLOCK_verification_cache_get (struct GNUNET_BLOCK_VerificationCache *cache,
+                                     const struct GNUNET_HashCode *block_hash);
+
+
+/**
+ * Remember the result of verifying a block.
+ *
+ * @param cache cache to use
+ * @param block_hash hash of the complete block (including its signature)
+ * @param result #GNUNET_OK if the block is valid, #GNUNET_SYSERR if not
+ */
+void
+GNUNET_BLOCK_verification_cache_put (struct GNUNET_BLOCK_VerificationCache *cache,
+                                     const struct GNUNET_HashCode *block_hash,
+                                     int result);
+
+
 /**
  * Each plugin is required to return a pointer to a struct of this
  * type as the return value from its entry point.
@@ -97,7 +97,23 @@ enum GNUNET_CADET_ChannelOption
    * Only for use in @c GNUNET_CADET_channel_get_info
    * struct GNUNET_PeerIdentity *peer
    */
-  GNUNET_CADET_OPTION_PEER       = 0x8
+  GNUNET_CADET_OPTION_PEER       = 0x8,
+
+  /**
+   * Stripe reliable data over all ready connections of the tunnel
+   * instead of using a single one.  Only has an effect on reliable
+   * channels.
+   * Yes/No.
+   */
+  GNUNET_CADET_OPTION_MULTIPATH  = 0x10,
+
+  /**
+   * Use a congestion window of up to 1024 unacknowledged messages,
+   * selective and delayed ACKs instead of the fixed 64 message window.
+   * Only has an effect on reliable channels.
+   * Yes/No.
+   */
+  GNUNET_CADET_OPTION_WINDOW     = 0x20
 
 };
 
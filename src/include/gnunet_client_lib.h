@@ -142,6 +142,35 @@ GNUNET_CLIENT_notify_transmit_ready_cancel (struct GNUNET_CLIENT_TransmitHandle
                                             *th);
 
 
+/**
+ * Transmit messages to the service without copying them.  Unlike
+ * #GNUNET_CLIENT_notify_transmit_ready(), this never (re)connects or
+ * retries; it is only available once the connection is established,
+ * and the caller should fall back to
+ * #GNUNET_CLIENT_notify_transmit_ready() if NULL is returned.  The
+ * messages must remain valid until @a cont is called or the request is
+ * cancelled using #GNUNET_CLIENT_notify_transmit_ready_cancel().
+ *
+ * @param client connection to the service
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up (and call
+ *        @a cont with #GNUNET_SYSERR)?
+ * @param cont function to call once the messages were transmitted
+ * @param cont_cls closure for @a cont
+ * @return NULL if the messages cannot be transmitted this way
+ *         right now, otherwise a handle to cancel the request
+ */
+struct GNUNET_CLIENT_TransmitHandle *
+GNUNET_CLIENT_transmit_messages (struct GNUNET_CLIENT_Connection *client,
+                                 const struct GNUNET_MessageHeader *const *msgs,
+                                 unsigned int count,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_CONNECTION_TransmitContinuation cont,
+                                 void *cont_cls);
+
+
 /**
  * Convenience API that combines sending a request
  * to the service and waiting for a response.
@@ -427,12 +427,13 @@ GNUNET_log_from_nocheck (enum GNUNET_ErrorType kind, const char *comp,
 #define GNUNET_log_from(kind,comp,...) do { int log_line = __LINE__;\
   static int log_call_enabled = GNUNET_LOG_CALL_STATUS;\
   if ((GNUNET_EXTRA_LOGGING > 0) || ((GNUNET_ERROR_TYPE_DEBUG & (kind)) == 0)) { \
-    if (GN_UNLIKELY(log_call_enabled == -1))\
-      log_call_enabled = GNUNET_get_log_call_status ((kind) & (~GNUNET_ERROR_TYPE_BULK), (comp), __FILE__, __FUNCTION__, log_line); \
-    if (GN_UNLIKELY(GNUNET_get_log_skip () > 0)) { GNUNET_log_skip (-1, GNUNET_NO); }\
-    else {\
-      if (GN_UNLIKELY(log_call_enabled))\
-        GNUNET_log_from_nocheck ((kind), comp, __VA_ARGS__);	\
+    if (GN_UNLIKELY(0 != log_call_enabled)) {\
+      if (GN_UNLIKELY(log_call_enabled == -1))\
+        log_call_enabled = GNUNET_get_log_call_status ((kind) & (~GNUNET_ERROR_TYPE_BULK), (comp), __FILE__, __FUNCTION__, log_line);\
+      if (GN_UNLIKELY(log_call_enabled)) {\
+        if (GN_UNLIKELY(GNUNET_get_log_skip () > 0)) { GNUNET_log_skip (-1, GNUNET_NO); }\
+        else { GNUNET_log_from_nocheck ((kind), comp, __VA_ARGS__); }\
+      }\
     }\
   }\
 } while (0)
@@ -440,12 +441,13 @@ GNUNET_log_from_nocheck (enum GNUNET_ErrorType kind, const char *comp,
  #define GNUNET_log(kind,...) do { int log_line = __LINE__;\
   static int log_call_enabled = GNUNET_LOG_CALL_STATUS;\
   if ((GNUNET_EXTRA_LOGGING > 0) || ((GNUNET_ERROR_TYPE_DEBUG & (kind)) == 0)) { \
-    if (GN_UNLIKELY(log_call_enabled == -1))\
-      log_call_enabled = GNUNET_get_log_call_status ((kind) & (~GNUNET_ERROR_TYPE_BULK), NULL, __FILE__, __FUNCTION__, log_line);\
-    if (GN_UNLIKELY(GNUNET_get_log_skip () > 0)) { GNUNET_log_skip (-1, GNUNET_NO); }\
-    else {\
-      if (GN_UNLIKELY(log_call_enabled))\
-        GNUNET_log_nocheck ((kind), __VA_ARGS__);	\
+    if (GN_UNLIKELY(0 != log_call_enabled)) {\
+      if (GN_UNLIKELY(log_call_enabled == -1))\
+        log_call_enabled = GNUNET_get_log_call_status ((kind) & (~GNUNET_ERROR_TYPE_BULK), NULL, __FILE__, __FUNCTION__, log_line);\
+      if (GN_UNLIKELY(log_call_enabled)) {\
+        if (GN_UNLIKELY(GNUNET_get_log_skip () > 0)) { GNUNET_log_skip (-1, GNUNET_NO); }\
+        else { GNUNET_log_nocheck ((kind), __VA_ARGS__); }\
+      }\
     }\
   }\
 } while (0)
@@ -901,6 +903,58 @@ GNUNET_ntoh_double (double d);
  */
 #define GNUNET_array_append(arr,size,element) do { GNUNET_array_grow(arr,size,size+1); arr[size-1] = element; } while(0)
 
+/**
+ * @ingroup memory
+ * Pool of memory blocks of a fixed size.  Freed blocks are kept on a
+ * (bounded) free list and handed out again by the next allocation,
+ * which avoids calls to malloc() and free() for short-lived objects
+ * that are allocated and released at a high rate.  Pools are not
+ * thread-safe.
+ */
+struct GNUNET_MemoryPool;
+
+/**
+ * @ingroup memory
+ * Allocate a struct or union of the given @a type from a pool.
+ * Like #GNUNET_new, the memory is zero'ed out.  The pool is created
+ * on first use; all allocations from the same pool must be for the
+ * same @a type.
+ *
+ * @param pool a `struct GNUNET_MemoryPool *` variable, initially NULL
+ * @param type name of the struct or union, i.e. pass 'struct Foo'.
+ */
+#define GNUNET_pool_new(pool, type) (type *) GNUNET_pool_malloc (pool, sizeof (type))
+
+/**
+ * @ingroup memory
+ * Allocate a block of memory from a pool.  The memory will be
+ * zero'ed out.  All allocations from the same pool must be of the
+ * same @a size.
+ *
+ * @param pool a `struct GNUNET_MemoryPool *` variable, initially NULL
+ * @param size the number of bytes to allocate
+ * @return pointer to @a size bytes of memory, never NULL (!)
+ */
+#define GNUNET_pool_malloc(pool, size) GNUNET_xpool_malloc_(&(pool), size, __FILE__, __LINE__)
+
+/**
+ * @ingroup memory
+ * Return a block of memory to the pool it was allocated from.
+ *
+ * @param pool the pool @a ptr was allocated from
+ * @param ptr memory to free, must not be NULL
+ */
+#define GNUNET_pool_free(pool, ptr) GNUNET_xpool_free_(pool, ptr, __FILE__, __LINE__)
+
+/**
+ * @ingroup memory
+ * Release a pool and all blocks on its free list.  All blocks
+ * allocated from the pool must have been returned before.
+ *
+ * @param pool the pool to destroy, set to NULL
+ */
+#define GNUNET_pool_destroy(pool) do { GNUNET_xpool_destroy_ (pool, __FILE__, __LINE__); (pool) = NULL; } while (0)
+
 /**
  * @ingroup memory
  * Like snprintf, just aborts if the buffer is of insufficient size.
@@ -998,6 +1052,54 @@ void
 GNUNET_xfree_ (void *ptr, const char *filename, int linenumber);
 
 
+/**
+ * Allocate memory from a pool, creating the pool if needed.  Don't
+ * use GNUNET_xpool_malloc_ directly.  Use the #GNUNET_pool_malloc
+ * and #GNUNET_pool_new macros.  The memory will be zero'ed out.
+ *
+ * @param pool the pool to allocate from, created if *pool is NULL
+ * @param size number of bytes to allocate
+ * @param filename where is this call being made (for debugging)
+ * @param linenumber line where this call is being made (for debugging)
+ * @return allocated memory, never NULL
+ */
+void *
+GNUNET_xpool_malloc_ (struct GNUNET_MemoryPool **pool,
+                      size_t size,
+                      const char *filename,
+                      int linenumber);
+
+
+/**
+ * Return memory to a pool.  Don't use GNUNET_xpool_free_ directly.
+ * Use the #GNUNET_pool_free macro.
+ *
+ * @param pool the pool @a ptr was allocated from
+ * @param ptr pointer to memory to free
+ * @param filename where is this call being made (for debugging)
+ * @param linenumber line where this call is being made (for debugging)
+ */
+void
+GNUNET_xpool_free_ (struct GNUNET_MemoryPool *pool,
+                    void *ptr,
+                    const char *filename,
+                    int linenumber);
+
+
+/**
+ * Destroy a pool.  Don't use GNUNET_xpool_destroy_ directly.  Use
+ * the #GNUNET_pool_destroy macro.
+ *
+ * @param pool the pool to destroy, may be NULL
+ * @param filename where is this call being made (for debugging)
+ * @param linenumber line where this call is being made (for debugging)
+ */
+void
+GNUNET_xpool_destroy_ (struct GNUNET_MemoryPool *pool,
+                       const char *filename,
+                       int linenumber);
+
+
 /**
  * Dup a string. Don't call GNUNET_xstrdup_ directly. Use the #GNUNET_strdup macro.
  * @param str string to duplicate
@@ -84,6 +84,30 @@ GNUNET_CONFIGURATION_load (struct GNUNET_CONFIGURATION_Handle *cfg,
                            const char *filename);
 
 
+/**
+ * Name of the environment variable with the file name of a
+ * configuration snapshot, see #GNUNET_CONFIGURATION_snapshot_write().
+ */
+#define GNUNET_CONFIGURATION_SNAPSHOT_ENV "GNUNET_CONFIG_SNAPSHOT"
+
+
+/**
+ * Load the configuration like #GNUNET_CONFIGURATION_load() would and
+ * store the result in a pre-parsed binary snapshot.  If the
+ * environment variable #GNUNET_CONFIGURATION_SNAPSHOT_ENV names the
+ * snapshot, #GNUNET_CONFIGURATION_load() uses it instead of parsing
+ * the configuration files again, as long as @a filename and the
+ * defaults directory did not change since the snapshot was written.
+ *
+ * @param snapshot name of the snapshot file to write
+ * @param filename name of the configuration file
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CONFIGURATION_snapshot_write (const char *snapshot,
+                                     const char *filename);
+
+
 /**
  * Load default configuration.  This function will parse the
  * defaults from the given defaults_d directory.
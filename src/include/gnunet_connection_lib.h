@@ -114,6 +114,30 @@ typedef void (*GNUNET_CONNECTION_Receiver) (void *cls, const void *buf,
 void
 GNUNET_CONNECTION_persist_ (struct GNUNET_CONNECTION_Handle *connection);
 
+
+/**
+ * Offer the service we just connected to (via a UNIX domain socket)
+ * to exchange data through shared memory instead of the socket.
+ * Must be called before anything else is done with the connection.
+ * Until the service answered, transmissions and receptions wait.
+ *
+ * @param connection fresh connection to a service
+ */
+void
+GNUNET_CONNECTION_shm_offer_ (struct GNUNET_CONNECTION_Handle *connection);
+
+
+/**
+ * Check if the client on a freshly accepted UNIX domain connection
+ * offers shared memory, and accept the offer if possible.  Until the
+ * first bytes from the client arrived, transmissions wait; so this
+ * must only be used for protocols where the client speaks first.
+ *
+ * @param connection freshly accepted connection
+ */
+void
+GNUNET_CONNECTION_shm_probe_ (struct GNUNET_CONNECTION_Handle *connection);
+
 /**
  * Disable the "CORK" feature for communication with the given socket,
  * forcing the OS to immediately flush the buffer on transmission
@@ -129,6 +153,21 @@ int
 GNUNET_CONNECTION_disable_corking (struct GNUNET_CONNECTION_Handle *connection);
 
 
+/**
+ * Limit the amount of data that the kernel buffers for the given
+ * connection beyond what it could already send, so that queued data
+ * stays with the application as long as possible.
+ *
+ * @param connection the connection to configure
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if this is not
+ *         supported (or the connection has no socket yet)
+ */
+int
+GNUNET_CONNECTION_set_notsent_lowat (struct GNUNET_CONNECTION_Handle *connection,
+                                     uint32_t bytes);
+
+
 /**
  * Create a connection handle by (asynchronously) connecting to a host.
  * This function returns immediately, even if the connection has not
@@ -276,6 +315,29 @@ GNUNET_CONNECTION_receive (struct GNUNET_CONNECTION_Handle *connection, size_t m
                            void *receiver_cls);
 
 
+/**
+ * Receive data from the given connection into a buffer provided by
+ * the caller.  Like #GNUNET_CONNECTION_receive(), except that the
+ * data is read directly into @a buf, which is also what is passed
+ * to @a receiver.  @a buf must remain valid until @a receiver was
+ * called or the receive was cancelled.
+ *
+ * @param connection connection handle
+ * @param buf where to store the received data
+ * @param max maximum number of bytes to read, size of @a buf
+ * @param timeout maximum amount of time to wait
+ * @param receiver function to call with received data
+ * @param receiver_cls closure for @a receiver
+ */
+void
+GNUNET_CONNECTION_receive_into (struct GNUNET_CONNECTION_Handle *connection,
+                                void *buf,
+                                size_t max,
+                                struct GNUNET_TIME_Relative timeout,
+                                GNUNET_CONNECTION_Receiver receiver,
+                                void *receiver_cls);
+
+
 /**
  * Cancel receive job on the given connection.  Note that the
  * receiver callback must not have been called yet in order
@@ -359,6 +421,57 @@ GNUNET_CONNECTION_notify_transmit_ready_cancel (struct
                                                 *th);
 
 
+/**
+ * Maximum number of messages that can be passed to
+ * #GNUNET_CONNECTION_transmit_messages() at once.
+ */
+#define GNUNET_CONNECTION_MAX_MESSAGES 16
+
+
+/**
+ * Function called once messages given to
+ * #GNUNET_CONNECTION_transmit_messages() were transmitted (or
+ * transmission failed).
+ *
+ * @param cls closure
+ * @param result #GNUNET_OK if all messages were passed to the
+ *        kernel, #GNUNET_SYSERR on timeout or errors
+ */
+typedef void
+(*GNUNET_CONNECTION_TransmitContinuation) (void *cls,
+                                           int result);
+
+
+/**
+ * Transmit messages without copying them into the write buffer
+ * of the connection.  The messages are sent, after any data that
+ * is already buffered, with as few system calls as possible.  The
+ * caller must keep @a msgs valid until @a cont was called or the
+ * transmission was cancelled with
+ * #GNUNET_CONNECTION_notify_transmit_ready_cancel().  Like
+ * #GNUNET_CONNECTION_notify_transmit_ready(), only one request
+ * may be pending per connection.
+ *
+ * @param connection connection
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up if we cannot
+ *        start the transmission?
+ * @param cont function to call once the messages were sent
+ * @param cont_cls closure for @a cont
+ * @return non-NULL if the transmission was queued,
+ *         NULL if we are already going to notify someone else (busy)
+ */
+struct GNUNET_CONNECTION_TransmitHandle *
+GNUNET_CONNECTION_transmit_messages (struct GNUNET_CONNECTION_Handle *connection,
+                                     const struct GNUNET_MessageHeader *const *msgs,
+                                     unsigned int count,
+                                     struct GNUNET_TIME_Relative timeout,
+                                     GNUNET_CONNECTION_TransmitContinuation cont,
+                                     void *cont_cls);
+
+
 /**
  * Create a connection to be proxied using a given connection.
  *
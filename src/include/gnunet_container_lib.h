@@ -208,6 +208,73 @@ GNUNET_CONTAINER_bloomfilter_init (const char *data,
                                    unsigned int k);
 
 
+/**
+ * @ingroup bloomfilter
+ * Load a blocked Bloom filter from a file.  A blocked filter keeps
+ * all bits of an element within one 64-byte block (a cache line),
+ * so a test touches a single block.  This costs a slightly higher
+ * false positive rate.  The bit layout differs from that of a normal
+ * filter, so the two must never be mixed.
+ *
+ * @param filename the name of the file (or the prefix)
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); will be rounded up
+ *        to next power of 2
+ * @param k the number of #GNUNET_CRYPTO_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter
+ */
+struct GNUNET_CONTAINER_BloomFilter *
+GNUNET_CONTAINER_bloomfilter_load_blocked (const char *filename,
+                                           size_t size,
+                                           unsigned int k);
+
+
+/**
+ * @ingroup bloomfilter
+ * Create a blocked Bloom filter from raw bits.
+ *
+ * @param data the raw bits in memory (maybe NULL,
+ *        in which case all bits should be considered
+ *        to be zero).
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); also size of @a data
+ *        -- unless data is NULL.  Must be a multiple of 64.
+ * @param k the number of #GNUNET_CRYPTO_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @return the bloomfilter, NULL if @a size is not a multiple of 64
+ */
+struct GNUNET_CONTAINER_BloomFilter *
+GNUNET_CONTAINER_bloomfilter_init_blocked (const char *data,
+                                           size_t size,
+                                           unsigned int k);
+
+
+/**
+ * @ingroup bloomfilter
+ * Load a memory-mapped Bloom filter from a file.  Both the bits and
+ * the usage counters live in the mapped file, so loading is cheap
+ * and updates are plain memory writes.  Call
+ * #GNUNET_CONTAINER_bloomfilter_sync() to write changes to disk.
+ *
+ * @param filename the name of the file
+ * @param size the size of the bloom-filter (number of
+ *        bytes of storage space to use); will be rounded up
+ *        to next power of 2
+ * @param k the number of #GNUNET_CRYPTO_hash-functions to apply per
+ *        element (number of bits set per element in the set)
+ * @param blocked #GNUNET_YES for a blocked filter (see
+ *        #GNUNET_CONTAINER_bloomfilter_load_blocked())
+ * @return the bloomfilter, NULL on error, including if the file
+ *         exists but was created with other parameters
+ */
+struct GNUNET_CONTAINER_BloomFilter *
+GNUNET_CONTAINER_bloomfilter_load_mapped (const char *filename,
+                                          size_t size,
+                                          unsigned int k,
+                                          int blocked);
+
+
 /**
  * @ingroup bloomfilter
  * Copy the raw data of this Bloom filter into
@@ -284,6 +351,18 @@ void
 GNUNET_CONTAINER_bloomfilter_free (struct GNUNET_CONTAINER_BloomFilter *bf);
 
 
+/**
+ * @ingroup bloomfilter
+ * Write all changes of a file-backed Bloom filter to disk.
+ *
+ * @param bf the filter
+ * @return #GNUNET_OK on success (or if @a bf is not backed by
+ *         a file), #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CONTAINER_bloomfilter_sync (const struct GNUNET_CONTAINER_BloomFilter *bf);
+
+
 /**
  * Get the number of the addresses set per element in the bloom filter.
  *
@@ -967,6 +1046,62 @@ GNUNET_CONTAINER_multihashmap_get_random (const struct GNUNET_CONTAINER_MultiHas
                                           void *it_cls);
 
 
+/**
+ * @ingroup hashmap
+ * Make sure the map can hold at least @a count entries in total
+ * without rehashing.  Useful before loading many entries at once.
+ *
+ * @param map the map
+ * @param count expected number of entries
+ */
+void
+GNUNET_CONTAINER_multihashmap_reserve (struct GNUNET_CONTAINER_MultiHashMap *map,
+                                       unsigned int count);
+
+
+/**
+ * @ingroup hashmap
+ * Store many key-value pairs in the map.  The map is grown once
+ * for all of them, and slots are prefetched ahead of the inserts.
+ * For maps created with @e do_not_copy_keys, the @a keys array must
+ * remain valid as long as the entries are in the map.
+ *
+ * @param map the map
+ * @param keys array of @a count keys
+ * @param values array of @a count values
+ * @param count number of pairs to store
+ * @param opt options for put, applied to each pair
+ * @return number of pairs that were added to the map (pairs that
+ *         replaced a value or were rejected by UNIQUE_ONLY are not
+ *         counted)
+ */
+unsigned int
+GNUNET_CONTAINER_multihashmap_put_multiple (struct GNUNET_CONTAINER_MultiHashMap *map,
+                                            const struct GNUNET_HashCode *keys,
+                                            void *const *values,
+                                            unsigned int count,
+                                            enum GNUNET_CONTAINER_MultiHashMapOption opt);
+
+
+/**
+ * @ingroup hashmap
+ * Look up many keys in the map at once, prefetching slots ahead
+ * of the lookups.
+ *
+ * @param map the map
+ * @param keys array of @a count keys to look up
+ * @param[out] values array of @a count values, set to the (first)
+ *             value for each key, or NULL if the key is not in the map
+ * @param count number of keys
+ * @return number of keys that were found
+ */
+unsigned int
+GNUNET_CONTAINER_multihashmap_get_many (const struct GNUNET_CONTAINER_MultiHashMap *map,
+                                        const struct GNUNET_HashCode *keys,
+                                        void **values,
+                                        unsigned int count);
+
+
 /* ***************** Version of Multihashmap for peer identities ****************** */
 
 /**
@@ -1887,7 +2022,8 @@ typedef int
 
 /**
  * @ingroup heap
- * Iterate over all entries in the heap.
+ * Iterate over all entries in the heap.  The @a iterator may
+ * remove nodes, but must not otherwise modify the heap.
  *
  * @param heap the heap
  * @param iterator function to call on each entry
@@ -304,6 +304,20 @@ struct GNUNET_CRYPTO_SymmetricSessionKey
 
 };
 
+
+/**
+ * Point on a curve (always for Curve25519) encoded in a format suitable
+ * for network transmission (ECDH), see http://cr.yp.to/ecdh.html.
+ */
+struct GNUNET_CRYPTO_EccPoint
+{
+  /**
+   * Q consists of an x- and a y-value, each mod p (256 bits), given
+   * here in affine coordinates and Ed25519 standard compact format.
+   */
+  unsigned char q_y[256 / 8];
+};
+
 GNUNET_NETWORK_STRUCT_END
 
 /**
@@ -361,6 +375,16 @@ struct GNUNET_CRYPTO_PaillierPrivateKey
    * Mu-component of the private key.
    */
   unsigned char mu[GNUNET_CRYPTO_PAILLIER_BITS / 8];
+  /**
+   * First prime factor of n, used for decryption with the CRT.
+   * All zeros if unknown.
+   */
+  unsigned char p[GNUNET_CRYPTO_PAILLIER_BITS / 16];
+  /**
+   * Second prime factor of n, used for decryption with the CRT.
+   * All zeros if unknown.
+   */
+  unsigned char q[GNUNET_CRYPTO_PAILLIER_BITS / 16];
 };
 
 
@@ -547,6 +571,198 @@ GNUNET_CRYPTO_symmetric_decrypt (const void *block,
                                  void *result);
 
 
+/**
+ * @ingroup crypto
+ * Handle for a keyed symmetric cipher context.  Keeps the cipher
+ * handles and the expanded key schedule alive between operations so
+ * that callers encrypting many messages under the same session key
+ * only pay for the key setup once.
+ */
+struct GNUNET_CRYPTO_SymmetricContext;
+
+
+/**
+ * @ingroup crypto
+ * Create a symmetric cipher context for the given session key.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free using #GNUNET_CRYPTO_symmetric_context_destroy()
+ */
+struct GNUNET_CRYPTO_SymmetricContext *
+GNUNET_CRYPTO_symmetric_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey);
+
+
+/**
+ * @ingroup crypto
+ * Change the session key of a symmetric cipher context.  Does
+ * nothing if @a sessionkey matches the key already in use.
+ *
+ * @param ctx the context to update
+ * @param sessionkey the new key
+ */
+void
+GNUNET_CRYPTO_symmetric_context_set_key (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey);
+
+
+/**
+ * @ingroup crypto
+ * Encrypt a block using a symmetric cipher context.  Produces the
+ * same output as #GNUNET_CRYPTO_symmetric_encrypt() with the
+ * context's key.
+ *
+ * @param ctx the context to use
+ * @param block the block to encrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same as
+ *        or overlap with @a block
+ * @return the size of the encrypted block, -1 for errors
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_encrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result);
+
+
+/**
+ * @ingroup crypto
+ * Decrypt a block using a symmetric cipher context.  Produces the
+ * same output as #GNUNET_CRYPTO_symmetric_decrypt() with the
+ * context's key.
+ *
+ * @param ctx the context to use
+ * @param block the data to decrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same as
+ *        or overlap with @a block
+ * @return -1 on failure, size of decrypted block on success
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_decrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result);
+
+
+/**
+ * @ingroup crypto
+ * Destroy a symmetric cipher context, wiping the key material.
+ *
+ * @param ctx the context to destroy
+ */
+void
+GNUNET_CRYPTO_symmetric_context_destroy (struct GNUNET_CRYPTO_SymmetricContext *ctx);
+
+
+/**
+ * Length of the nonce used by #GNUNET_CRYPTO_aead_encrypt().
+ */
+#define GNUNET_CRYPTO_AEAD_NONCE_LENGTH 12
+
+/**
+ * Length of the tag produced by #GNUNET_CRYPTO_aead_encrypt().
+ */
+#define GNUNET_CRYPTO_AEAD_TAG_LENGTH 16
+
+
+/**
+ * @ingroup crypto
+ * Handle for a keyed AEAD (AES-256-GCM) cipher context, which
+ * encrypts and authenticates in a single pass.
+ */
+struct GNUNET_CRYPTO_AeadContext;
+
+
+/**
+ * @ingroup crypto
+ * Create an AEAD context for the given session key.  Only the AES
+ * half of the session key is used.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free using #GNUNET_CRYPTO_aead_context_destroy()
+ */
+struct GNUNET_CRYPTO_AeadContext *
+GNUNET_CRYPTO_aead_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey);
+
+
+/**
+ * @ingroup crypto
+ * Change the session key of an AEAD context.  Does nothing if
+ * @a sessionkey matches the key already in use.
+ *
+ * @param ctx the context to update
+ * @param sessionkey the new key
+ */
+void
+GNUNET_CRYPTO_aead_context_set_key (struct GNUNET_CRYPTO_AeadContext *ctx,
+                                    const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey);
+
+
+/**
+ * @ingroup crypto
+ * Encrypt and authenticate a block in place.  The caller must
+ * never use the same @a nonce twice with the same key.
+ *
+ * @param ctx the context to use
+ * @param nonce #GNUNET_CRYPTO_AEAD_NONCE_LENGTH bytes of nonce
+ * @param aad additional data to authenticate (not encrypted)
+ * @param aad_size number of bytes in @a aad
+ * @param block the block to encrypt in place
+ * @param size the size of the @a block
+ * @param tag where to store the #GNUNET_CRYPTO_AEAD_TAG_LENGTH
+ *        bytes of the authentication tag
+ */
+void
+GNUNET_CRYPTO_aead_encrypt (struct GNUNET_CRYPTO_AeadContext *ctx,
+                            const void *nonce,
+                            const void *aad,
+                            size_t aad_size,
+                            void *block,
+                            size_t size,
+                            void *tag);
+
+
+/**
+ * @ingroup crypto
+ * Verify and decrypt a block in place.
+ *
+ * @param ctx the context to use
+ * @param nonce #GNUNET_CRYPTO_AEAD_NONCE_LENGTH bytes of nonce
+ * @param aad additional data that was authenticated
+ * @param aad_size number of bytes in @a aad
+ * @param block the block to decrypt in place
+ * @param size the size of the @a block
+ * @param tag the #GNUNET_CRYPTO_AEAD_TAG_LENGTH bytes of the
+ *        authentication tag
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a block or
+ *         @a aad were not authentic (@a block is garbage then)
+ */
+int
+GNUNET_CRYPTO_aead_decrypt (struct GNUNET_CRYPTO_AeadContext *ctx,
+                            const void *nonce,
+                            const void *aad,
+                            size_t aad_size,
+                            void *block,
+                            size_t size,
+                            const void *tag);
+
+
+/**
+ * @ingroup crypto
+ * Destroy an AEAD context, wiping the key material.
+ *
+ * @param ctx the context to destroy
+ */
+void
+GNUNET_CRYPTO_aead_context_destroy (struct GNUNET_CRYPTO_AeadContext *ctx);
+
+
+
 /**
  * @ingroup crypto
  * @brief Derive an IV
@@ -649,6 +865,24 @@ GNUNET_CRYPTO_hash (const void *block,
                     struct GNUNET_HashCode *ret);
 
 
+/**
+ * @ingroup hash
+ * Compute the hashes of many independent blocks.  The results are
+ * the same as calling #GNUNET_CRYPTO_hash() on each block, but
+ * large batches are hashed by several threads in parallel.
+ *
+ * @param blocks the blocks to hash
+ * @param sizes sizes of the @a blocks
+ * @param n number of blocks
+ * @param ret array of @a n hash codes to write the results to
+ */
+void
+GNUNET_CRYPTO_hash_many (const void *const *blocks,
+                         const size_t *sizes,
+                         unsigned int n,
+                         struct GNUNET_HashCode *ret);
+
+
 /**
  * Context for cummulative hashing.
  */
@@ -750,6 +984,25 @@ GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
                          void *callback_cls);
 
 
+/**
+ * @ingroup hash
+ * Compute the hash of an entire file, reading and hashing it in a
+ * worker thread of the crypto offload pool so that the main loop
+ * stays responsive while large files are hashed.
+ *
+ * @param filename name of file to hash
+ * @param blocksize number of bytes to read at once
+ * @param callback function to call upon completion
+ * @param callback_cls closure for @a callback
+ * @return NULL on (immediate) errror
+ */
+struct GNUNET_CRYPTO_FileHashContext *
+GNUNET_CRYPTO_hash_file_offload (const char *filename,
+                                 size_t blocksize,
+                                 GNUNET_CRYPTO_HashCompletedCallback callback,
+                                 void *callback_cls);
+
+
 /**
  * Cancel a file hashing operation.
  *
@@ -1287,6 +1540,8 @@ struct GNUNET_CRYPTO_EccDlogContext;
 
 /**
  * Do pre-calculation for ECC discrete logarithm for small factors.
+ * The table can be stored with #GNUNET_CRYPTO_ecc_dlog_write()
+ * and later be loaded using #GNUNET_CRYPTO_ecc_dlog_load().
  * 
  * @param max maximum value the factor can be
  * @param mem memory to use (should be smaller than @a max), must not be zero.
@@ -1297,6 +1552,74 @@ GNUNET_CRYPTO_ecc_dlog_prepare (unsigned int max,
 				unsigned int mem);
 
 
+/**
+ * Store the pre-calculated values of @a edc in a file, so that they
+ * can be loaded quickly and shared between processes using
+ * #GNUNET_CRYPTO_ecc_dlog_load().
+ *
+ * @param edc context created with #GNUNET_CRYPTO_ecc_dlog_prepare()
+ * @param filename where to store the table
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CRYPTO_ecc_dlog_write (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+                              const char *filename);
+
+
+/**
+ * Load pre-calculated values for ECC discrete logarithm from a file
+ * written by #GNUNET_CRYPTO_ecc_dlog_write().  The file is mapped
+ * read-only, so that processes using the same table share the memory.
+ *
+ * @param filename file with the table
+ * @param max maximum value the factor can be, must match the table
+ * @param mem memory to use, must match the table
+ * @return NULL if the file does not exist or does not match
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_dlog_load (const char *filename,
+                             unsigned int max,
+                             unsigned int mem);
+
+
+/**
+ * Create a context for ECC additions and multiplications that does
+ * not support #GNUNET_CRYPTO_ecc_dlog().  Creating such a context is
+ * cheap.  As contexts must not be shared between threads, this is
+ * what worker threads should use.
+ *
+ * @return NULL on error
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_context_create (void);
+
+
+/**
+ * Convert point value to binary representation.
+ *
+ * @param edc calculation context for ECC operations
+ * @param point computational point representation
+ * @param[out] bin binary point representation
+ */
+void
+GNUNET_CRYPTO_ecc_point_to_bin (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                                gcry_mpi_point_t point,
+                                struct GNUNET_CRYPTO_EccPoint *bin);
+
+
+/**
+ * Convert binary representation of a point to computational representation.
+ *
+ * @param edc calculation context for ECC operations
+ * @param bin binary point representation
+ * @return computational representation, NULL if @a bin is not a
+ *         valid point; must be freed using #GNUNET_CRYPTO_ecc_free()
+ */
+gcry_mpi_point_t
+GNUNET_CRYPTO_ecc_bin_to_point (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                                const struct GNUNET_CRYPTO_EccPoint *bin);
+
+
 /**
  * Calculate ECC discrete logarithm for small factors.
  * Opposite of #GNUNET_CRYPTO_ecc_dexp().
@@ -1342,6 +1665,20 @@ GNUNET_CRYPTO_ecc_dexp_mpi (struct GNUNET_CRYPTO_EccDlogContext *edc,
 			    gcry_mpi_t val);
 
 
+/**
+ * Multiply the point @a p on the elliptic curve by @a val.
+ *
+ * @param edc calculation context for ECC operations
+ * @param p point to multiply
+ * @param val value to multiply @a p by, may be negative
+ * @return @a p * @a val, must be freed using #GNUNET_CRYPTO_ecc_free()
+ */
+gcry_mpi_point_t
+GNUNET_CRYPTO_ecc_pmul_mpi (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                            gcry_mpi_point_t p,
+                            gcry_mpi_t val);
+
+
 /**
  * Add two points on the elliptic curve.
  * 
@@ -1492,6 +1829,48 @@ GNUNET_CRYPTO_eddsa_verify (uint32_t purpose,
                             const struct GNUNET_CRYPTO_EddsaPublicKey *pub);
 
 
+/**
+ * @ingroup crypto
+ * Verify EdDSA signature like #GNUNET_CRYPTO_eddsa_verify(), but
+ * without logging, so that it can be used from the functions run
+ * by the crypto offload pool.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
+ */
+int
+GNUNET_CRYPTO_eddsa_verify_nolog (uint32_t purpose,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                  const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                                  const struct GNUNET_CRYPTO_EddsaPublicKey *pub);
+
+
+/**
+ * @ingroup crypto
+ * Verify a batch of EdDSA signatures.  Does not log, so it can
+ * be used from the crypto offload pool.
+ *
+ * @param purpose what is the purpose that the signatures should have?
+ * @param count number of signatures to verify
+ * @param validate array of @a count blocks to validate
+ * @param sigs array of @a count signatures
+ * @param pubs array of @a count public keys of the signers
+ * @param results where to store #GNUNET_OK or #GNUNET_SYSERR for
+ *        each signature, can be NULL
+ * @return number of valid signatures
+ */
+unsigned int
+GNUNET_CRYPTO_eddsa_verify_batch (uint32_t purpose,
+                                  unsigned int count,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *const *validate,
+                                  const struct GNUNET_CRYPTO_EddsaSignature *sigs,
+                                  const struct GNUNET_CRYPTO_EddsaPublicKey *pubs,
+                                  int *results);
+
+
 
 /**
  * @ingroup crypto
@@ -1510,6 +1889,25 @@ GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
                             const struct GNUNET_CRYPTO_EcdsaPublicKey *pub);
 
 
+/**
+ * @ingroup crypto
+ * Verify ECDSA signature like #GNUNET_CRYPTO_ecdsa_verify(), but
+ * without logging, so that it can be used from the functions run
+ * by the crypto offload pool.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
+ */
+int
+GNUNET_CRYPTO_ecdsa_verify_nolog (uint32_t purpose,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                  const struct GNUNET_CRYPTO_EcdsaSignature *sig,
+                                  const struct GNUNET_CRYPTO_EcdsaPublicKey *pub);
+
+
 /**
  * @ingroup crypto
  * Derive a private key from a given private key and a label.
@@ -1547,6 +1945,59 @@ GNUNET_CRYPTO_ecdsa_public_key_derive (const struct GNUNET_CRYPTO_EcdsaPublicKey
                                        struct GNUNET_CRYPTO_EcdsaPublicKey *result);
 
 
+/**
+ * @ingroup crypto
+ * Context for deriving public keys for many labels from the same
+ * public key.
+ */
+struct GNUNET_CRYPTO_EcdsaDeriveContext;
+
+
+/**
+ * @ingroup crypto
+ * Create a context for deriving public keys from @a pub.  Creating
+ * the context precomputes a table of multiples of @a pub, which costs
+ * about as much as five calls to
+ * #GNUNET_CRYPTO_ecdsa_public_key_derive(); each derivation with the
+ * context is then several times faster than that function.  A context
+ * must not be used by several threads at once.
+ *
+ * @param pub original public key
+ * @param context additional context to use for HKDF of 'h'.
+ *        typically the name of the subsystem/application
+ * @return the derivation context
+ */
+struct GNUNET_CRYPTO_EcdsaDeriveContext *
+GNUNET_CRYPTO_ecdsa_derive_context_create (const struct GNUNET_CRYPTO_EcdsaPublicKey *pub,
+                                           const char *context);
+
+
+/**
+ * @ingroup crypto
+ * Derive a public key for a label, like
+ * #GNUNET_CRYPTO_ecdsa_public_key_derive() does for the public key
+ * and context that @a dc was created with.
+ *
+ * @param dc derivation context
+ * @param label label to use for key deriviation
+ * @param result where to write the derived public key
+ */
+void
+GNUNET_CRYPTO_ecdsa_derive_context_public_key (struct GNUNET_CRYPTO_EcdsaDeriveContext *dc,
+                                               const char *label,
+                                               struct GNUNET_CRYPTO_EcdsaPublicKey *result);
+
+
+/**
+ * @ingroup crypto
+ * Destroy a derivation context.
+ *
+ * @param dc context to destroy
+ */
+void
+GNUNET_CRYPTO_ecdsa_derive_context_destroy (struct GNUNET_CRYPTO_EcdsaDeriveContext *dc);
+
+
 /**
  * Output the given MPI value to the given buffer in network
  * byte order.  The MPI @a val may not be negative.
@@ -1620,6 +2071,93 @@ GNUNET_CRYPTO_paillier_decrypt (const struct GNUNET_CRYPTO_PaillierPrivateKey *p
                                 gcry_mpi_t m);
 
 
+/**
+ * Pool of precomputed values speeding up paillier encryptions
+ * with a given public key.
+ */
+struct GNUNET_CRYPTO_PaillierRandomPool;
+
+
+/**
+ * Create a pool of precomputed values for encryptions with
+ * @a public_key.  The pool is filled in the background using the
+ * crypto offload pool, and refilled as values are used up.  Must be
+ * called from within the scheduler.
+ *
+ * @param public_key key the values are for
+ * @param size number of values to keep ready
+ * @return NULL if @a public_key is invalid
+ */
+struct GNUNET_CRYPTO_PaillierRandomPool *
+GNUNET_CRYPTO_paillier_pool_create (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                    unsigned int size);
+
+
+/**
+ * Obtain the number of precomputed values that are ready for use.
+ *
+ * @param pool pool to inspect
+ * @return number of encryptions that can be done without a modular
+ *         exponentiation right now
+ */
+unsigned int
+GNUNET_CRYPTO_paillier_pool_get_available (const struct GNUNET_CRYPTO_PaillierRandomPool *pool);
+
+
+/**
+ * Destroy a pool of precomputed values.
+ *
+ * @param pool pool to destroy
+ */
+void
+GNUNET_CRYPTO_paillier_pool_destroy (struct GNUNET_CRYPTO_PaillierRandomPool *pool);
+
+
+/**
+ * Encrypt a number of plaintexts with a paillier public key.  Cheaper
+ * than individual calls to #GNUNET_CRYPTO_paillier_encrypt() as the
+ * key is only parsed once, and as precomputed values from @a pool
+ * are used while it has any.
+ *
+ * @param public_key Public key to use.
+ * @param pool precomputed values for @a public_key, or NULL
+ * @param m array of @a count plaintexts to encrypt
+ * @param count number of plaintexts
+ * @param desired_ops How many homomorphic ops the caller intends to use
+ * @param[out] ciphertexts array of @a count encryptions of @a m
+ * @return guaranteed number of supported homomorphic operations for
+ *         all ciphertexts, or desired_ops, in case that is lower,
+ *         or #GNUNET_SYSERR if @a public_key is invalid
+ */
+int
+GNUNET_CRYPTO_paillier_encrypt_batch (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                      struct GNUNET_CRYPTO_PaillierRandomPool *pool,
+                                      const gcry_mpi_t *m,
+                                      unsigned int count,
+                                      int desired_ops,
+                                      struct GNUNET_CRYPTO_PaillierCiphertext *ciphertexts);
+
+
+/**
+ * Decrypt a number of paillier ciphertexts with a private key.  Uses
+ * the Chinese Remainder Theorem if @a private_key includes the prime
+ * factors of n.
+ *
+ * @param private_key Private key to use for decryption.
+ * @param public_key Public key to use for decryption.
+ * @param ciphertexts array of @a count ciphertexts to decrypt
+ * @param count number of ciphertexts
+ * @param[out] m array of @a count initialized MPIs to store
+ *        the plaintexts in
+ */
+void
+GNUNET_CRYPTO_paillier_decrypt_batch (const struct GNUNET_CRYPTO_PaillierPrivateKey *private_key,
+                                      const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                      const struct GNUNET_CRYPTO_PaillierCiphertext *ciphertexts,
+                                      unsigned int count,
+                                      gcry_mpi_t *m);
+
+
 /**
  * Compute a ciphertext that represents the sum of the plaintext in @a x1 and @a x2
  *
@@ -2004,6 +2542,181 @@ GNUNET_CRYPTO_rsa_verify (const struct GNUNET_HashCode *hash,
 			  const struct GNUNET_CRYPTO_rsa_PublicKey *public_key);
 
 
+/**
+ * @ingroup crypto
+ * Handle for a job running in the crypto offload pool.
+ */
+struct GNUNET_CRYPTO_OffloadJob;
+
+
+/**
+ * @ingroup crypto
+ * Function run by a worker thread of the crypto offload pool.  Must
+ * be thread-safe: it must not use the scheduler, logging or any other
+ * state shared with the main loop.
+ *
+ * @param cls closure
+ * @return result to pass to the #GNUNET_CRYPTO_OffloadContinuation
+ */
+typedef int
+(*GNUNET_CRYPTO_OffloadFunction) (void *cls);
+
+
+/**
+ * @ingroup crypto
+ * Function called from the scheduler with the result of an
+ * offloaded job.
+ *
+ * @param cls closure
+ * @param result result of the job, for signature verification
+ *        #GNUNET_OK if the signature is valid, #GNUNET_SYSERR if not
+ */
+typedef void
+(*GNUNET_CRYPTO_OffloadContinuation) (void *cls,
+                                      int result);
+
+
+/**
+ * @ingroup crypto
+ * Function called from the scheduler with the result of an
+ * offloaded EdDSA signing job.
+ *
+ * @param cls closure
+ * @param sig the signature, NULL on error
+ */
+typedef void
+(*GNUNET_CRYPTO_EddsaSignContinuation) (void *cls,
+                                        const struct GNUNET_CRYPTO_EddsaSignature *sig);
+
+
+/**
+ * @ingroup crypto
+ * Function called from the scheduler with the result of an
+ * offloaded ECDH job.
+ *
+ * @param cls closure
+ * @param key_material the derived key material, NULL on error
+ */
+typedef void
+(*GNUNET_CRYPTO_EcdhContinuation) (void *cls,
+                                   const struct GNUNET_HashCode *key_material);
+
+
+/**
+ * @ingroup crypto
+ * Run @a work in a worker thread and pass its result to @a cont
+ * from the scheduler.  If the platform has no thread support, @a work
+ * is run right away, but @a cont is still called from a separate
+ * scheduler task.
+ *
+ * @param work function to run in a worker thread
+ * @param work_cls closure for @a work, must remain valid until
+ *        @a cont was called or the job was cancelled
+ * @param cont function to call with the result
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_offload (GNUNET_CRYPTO_OffloadFunction work,
+                       void *work_cls,
+                       GNUNET_CRYPTO_OffloadContinuation cont,
+                       void *cont_cls);
+
+
+/**
+ * @ingroup crypto
+ * Cancel an offloaded job; its continuation will not be called.  If
+ * the job is running right now, waits until the worker is done with
+ * it.
+ *
+ * @param job job to cancel
+ */
+void
+GNUNET_CRYPTO_offload_cancel (struct GNUNET_CRYPTO_OffloadJob *job);
+
+
+/**
+ * @ingroup crypto
+ * Verify an EdDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @param cont function to call with #GNUNET_OK if the signature is
+ *        valid, #GNUNET_SYSERR if not
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_eddsa_verify_offload (uint32_t purpose,
+                                    const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                    const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                                    const struct GNUNET_CRYPTO_EddsaPublicKey *pub,
+                                    GNUNET_CRYPTO_OffloadContinuation cont,
+                                    void *cont_cls);
+
+
+/**
+ * @ingroup crypto
+ * Verify an ECDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @param cont function to call with #GNUNET_OK if the signature is
+ *        valid, #GNUNET_SYSERR if not
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_ecdsa_verify_offload (uint32_t purpose,
+                                    const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                    const struct GNUNET_CRYPTO_EcdsaSignature *sig,
+                                    const struct GNUNET_CRYPTO_EcdsaPublicKey *pub,
+                                    GNUNET_CRYPTO_OffloadContinuation cont,
+                                    void *cont_cls);
+
+
+/**
+ * @ingroup crypto
+ * Create an EdDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param priv private key to use for the signing
+ * @param purpose what to sign (size, purpose, data)
+ * @param cont function to call with the signature
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_eddsa_sign_offload (const struct GNUNET_CRYPTO_EddsaPrivateKey *priv,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *purpose,
+                                  GNUNET_CRYPTO_EddsaSignContinuation cont,
+                                  void *cont_cls);
+
+
+/**
+ * @ingroup crypto
+ * Derive key material from a public and a private ECC key in the
+ * crypto offload pool.  The arguments are copied.
+ *
+ * @param priv private key to use for the ECDH (x)
+ * @param pub public key to use for the ECDH (yG)
+ * @param cont function to call with the key material (xyG)
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_ecc_ecdh_offload (const struct GNUNET_CRYPTO_EcdhePrivateKey *priv,
+                                const struct GNUNET_CRYPTO_EcdhePublicKey *pub,
+                                GNUNET_CRYPTO_EcdhContinuation cont,
+                                void *cont_cls);
+
+
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
 #endif
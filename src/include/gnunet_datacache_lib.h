@@ -172,6 +172,27 @@ GNUNET_DATACACHE_get_closest (struct GNUNET_DATACACHE_Handle *h,
                               void *iter_cls);
 
 
+/**
+ * Stream the entries of the datacache in the order of
+ * #GNUNET_DATACACHE_get_closest(), starting at @a key, until @a iter
+ * returns something other than #GNUNET_OK.  The plugin walks its key
+ * index once, so a range scan does not need repeated queries with
+ * growing limits.
+ *
+ * @param h handle to the datacache
+ * @param key where in the keyspace to start the scan
+ * @param iter function to call on each entry, returns #GNUNET_OK to
+ *        advance the scan and anything else to stop it
+ * @param iter_cls closure for @a iter
+ * @return the number of entries passed to @a iter
+ */
+unsigned int
+GNUNET_DATACACHE_scan (struct GNUNET_DATACACHE_Handle *h,
+                       const struct GNUNET_HashCode *key,
+                       GNUNET_DATACACHE_Iterator iter,
+                       void *iter_cls);
+
+
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
 #endif
@@ -168,7 +168,9 @@ struct GNUNET_DATACACHE_PluginFunctions
    *
    * @param cls closure (internal context for the plugin)
    * @param key area of the keyspace to look into
-   * @param num_results number of results that should be returned to @a iter
+   * @param num_results number of results that should be returned to @a iter,
+   *        UINT_MAX for a range scan that only ends when @a iter
+   *        returns something other than #GNUNET_OK
    * @param iter maybe NULL (to just count)
    * @param iter_cls closure for @a iter
    * @return the number of results found
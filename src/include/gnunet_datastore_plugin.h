@@ -308,6 +308,17 @@ typedef void
 (*PluginDrop) (void *cls);
 
 
+/**
+ * Start or finish a batch of operations.  All operations between
+ * the two calls should be applied together (i.e. in one database
+ * transaction).  The service never nests batches.
+ *
+ * @param cls closure
+ */
+typedef void
+(*PluginBatch) (void *cls);
+
+
 /**
  * Each plugin is required to return a pointer to a struct of this
  * type as the return value from its entry point.
@@ -382,6 +393,18 @@ struct GNUNET_DATASTORE_PluginFunctions
    */
   PluginGetKeys get_keys;
 
+  /**
+   * Start a batch of operations.  Can be NULL if the plugin
+   * does not group operations.
+   */
+  PluginBatch begin_batch;
+
+  /**
+   * Finish a batch of operations started with @e begin_batch.
+   * Can be NULL if the plugin does not group operations.
+   */
+  PluginBatch commit_batch;
+
 };
 
 
@@ -166,6 +166,90 @@ GNUNET_DATASTORE_put (struct GNUNET_DATASTORE_Handle *h,
                       void *cont_cls);
 
 
+/**
+ * One item of a batch of items to store with
+ * #GNUNET_DATASTORE_put_batch().
+ */
+struct GNUNET_DATASTORE_PutItem
+{
+  /**
+   * Key for the value.
+   */
+  const struct GNUNET_HashCode *key;
+
+  /**
+   * Number of bytes in @e data.
+   */
+  size_t size;
+
+  /**
+   * Content to store.
+   */
+  const void *data;
+
+  /**
+   * Type of the content.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Priority of the content.
+   */
+  uint32_t priority;
+
+  /**
+   * Anonymity-level for the content.
+   */
+  uint32_t anonymity;
+
+  /**
+   * How often should the content be replicated to other peers?
+   */
+  uint32_t replication;
+
+  /**
+   * Expiration time for the content.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+};
+
+
+/**
+ * Store several items in the datastore with a single request.  The
+ * service stores all items in one database transaction (if the
+ * plugin supports it) and answers once for the whole batch.  Each
+ * item is handled as by #GNUNET_DATASTORE_put().  All items must fit
+ * into a single message of less than #GNUNET_SERVER_MAX_MESSAGE_SIZE
+ * bytes (each item costs its size plus a small fixed header).
+ *
+ * @param h handle to the datastore
+ * @param rid reservation ID to use (from "reserve"); use 0 if no
+ *            prior reservation was made
+ * @param items items to store
+ * @param item_count number of entries in @a items, must be positive
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout timeout for the operation
+ * @param cont continuation to call when done; the status is
+ *        #GNUNET_SYSERR if any item failed, #GNUNET_OK if at least
+ *        one item was stored and #GNUNET_NO if all were already present
+ * @param cont_cls closure for @a cont
+ * @return NULL if the entry was not queued (or the batch is too
+ *         large), otherwise a handle that can be used to cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_put_batch (struct GNUNET_DATASTORE_Handle *h,
+                            uint32_t rid,
+                            const struct GNUNET_DATASTORE_PutItem *items,
+                            unsigned int item_count,
+                            unsigned int queue_priority,
+                            unsigned int max_queue_size,
+                            struct GNUNET_TIME_Relative timeout,
+                            GNUNET_DATASTORE_ContinuationWithStatus cont,
+                            void *cont_cls);
+
+
 /**
  * Signal that all of the data for which a reservation was made has
  * been stored and that whatever excess space might have been reserved
@@ -316,6 +400,38 @@ GNUNET_DATASTORE_get_key (struct GNUNET_DATASTORE_Handle *h,
                           void *proc_cls);
 
 
+/**
+ * Get the first result for each of several keys with a single
+ * request.  The processor is called once for every key that has a
+ * matching value (in no particular order) and finally once with a
+ * NULL key.
+ *
+ * @param h handle to the datastore
+ * @param keys keys to look up
+ * @param key_count number of entries in @a keys
+ * @param type desired type, 0 for any
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param proc function to call on each matching value;
+ *        and with a NULL value at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued (or too many keys were
+ *         given), otherwise a handle that can be used to cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_keys_multi (struct GNUNET_DATASTORE_Handle *h,
+                                 const struct GNUNET_HashCode *keys,
+                                 unsigned int key_count,
+                                 enum GNUNET_BLOCK_Type type,
+                                 unsigned int queue_priority,
+                                 unsigned int max_queue_size,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_DATASTORE_DatumProcessor proc,
+                                 void *proc_cls);
+
+
 /**
  * Get a single zero-anonymity value from the datastore.
  * Note that some implementations can ignore the 'offset' and
@@ -351,6 +467,38 @@ GNUNET_DATASTORE_get_zero_anonymity (struct GNUNET_DATASTORE_Handle *h,
                                      void *proc_cls);
 
 
+/**
+ * Get several zero-anonymity values from the datastore with a single
+ * request.  Works like #GNUNET_DATASTORE_get_zero_anonymity() for
+ * the offsets @a offset to @a offset + @a count - 1, except that the
+ * stream ends early at the first offset without a value.
+ *
+ * @param h handle to the datastore
+ * @param offset offset of the first result
+ * @param count maximum number of values to return
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param type allowed type for the operation (never zero)
+ * @param proc function to call on each value;
+ *        and always once with a value of NULL at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued, otherwise a handle that can be used to
+ *         cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_zero_anonymity_multi (struct GNUNET_DATASTORE_Handle *h,
+                                           uint64_t offset,
+                                           unsigned int count,
+                                           unsigned int queue_priority,
+                                           unsigned int max_queue_size,
+                                           struct GNUNET_TIME_Relative timeout,
+                                           enum GNUNET_BLOCK_Type type,
+                                           GNUNET_DATASTORE_DatumProcessor proc,
+                                           void *proc_cls);
+
+
 /**
  * Get a random value from the datastore for content replication.
  * Returns a single, random value among those with the highest
@@ -379,6 +527,34 @@ GNUNET_DATASTORE_get_for_replication (struct GNUNET_DATASTORE_Handle *h,
                                       void *proc_cls);
 
 
+/**
+ * Get a stream of values from the datastore for content replication.
+ * Works like #GNUNET_DATASTORE_get_for_replication(), except that
+ * up to @a count values are returned with a single request, each
+ * with its replication score lowered as described there.
+ *
+ * @param h handle to the datastore
+ * @param count maximum number of values to return
+ * @param queue_priority ranking of this request in the priority queue
+ * @param max_queue_size at what queue size should this request be dropped
+ *        (if other requests of higher priority are in the queue)
+ * @param timeout how long to wait at most for a response
+ * @param proc function to call on each value;
+ *        and always once with a value of NULL at the end
+ * @param proc_cls closure for @a proc
+ * @return NULL if the entry was not queued, otherwise a handle that can be used to
+ *         cancel
+ */
+struct GNUNET_DATASTORE_QueueEntry *
+GNUNET_DATASTORE_get_for_replication_multi (struct GNUNET_DATASTORE_Handle *h,
+                                            unsigned int count,
+                                            unsigned int queue_priority,
+                                            unsigned int max_queue_size,
+                                            struct GNUNET_TIME_Relative timeout,
+                                            GNUNET_DATASTORE_DatumProcessor proc,
+                                            void *proc_cls);
+
+
 
 /**
  * Cancel a datastore operation.  The final callback from the
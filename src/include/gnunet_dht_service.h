@@ -100,7 +100,16 @@ enum GNUNET_DHT_RouteOption
   /**
    * Flag given to monitors if this was the last hop for a GET/PUT.
    */
-  GNUNET_DHT_RO_LAST_HOP = 16
+  GNUNET_DHT_RO_LAST_HOP = 16,
+
+  /**
+   * Lower latency GET: the local peer asks several of the neighbours
+   * closest to the key in parallel and widens the search in quick
+   * rounds until the first reply arrives, instead of relying on the
+   * random walk and slow retries.  Results are still passed to the
+   * client as soon as they arrive.
+   */
+  GNUNET_DHT_RO_PARALLEL_LOOKUP = 32
 };
 
 
@@ -182,6 +191,68 @@ GNUNET_DHT_put (struct GNUNET_DHT_Handle *handle,
                 void *cont_cls);
 
 
+/**
+ * Record to store with #GNUNET_DHT_put_batch.
+ */
+struct GNUNET_DHT_PutRecord
+{
+  /**
+   * The key to store under.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Type of the value.
+   */
+  enum GNUNET_BLOCK_Type type;
+
+  /**
+   * Number of bytes in @e data.
+   */
+  size_t size;
+
+  /**
+   * The data to store.
+   */
+  const void *data;
+
+  /**
+   * Desired expiration time for the value.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+};
+
+
+/**
+ * Perform a PUT operation storing several records in the DHT with a
+ * single request.  The service routes records that share the next hop
+ * together.  All records must fit in one message to the service (64k);
+ * callers with more records should split them over several batches.
+ *
+ * @param handle handle to DHT service
+ * @param num_records number of entries in @a records
+ * @param records the records to store
+ * @param desired_replication_level estimate of how many
+ *                nearest peers each record should reach
+ * @param options routing options for this message
+ * @param timeout how long to wait for transmission of this request
+ * @param cont continuation to call when done (transmitting request to service)
+ *        You must not call #GNUNET_DHT_disconnect in this continuation
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the "PUT" operation, NULL on error
+ *        (batch too big)
+ */
+struct GNUNET_DHT_PutHandle *
+GNUNET_DHT_put_batch (struct GNUNET_DHT_Handle *handle,
+                      unsigned int num_records,
+                      const struct GNUNET_DHT_PutRecord *records,
+                      uint32_t desired_replication_level,
+                      enum GNUNET_DHT_RouteOption options,
+                      struct GNUNET_TIME_Relative timeout,
+                      GNUNET_DHT_PutContinuation cont,
+                      void *cont_cls);
+
+
 /**
  * Cancels a DHT PUT operation.  Note that the PUT request may still
  * go out over the network (we can't stop that); However, if the PUT
@@ -359,6 +430,53 @@ typedef void (*GNUNET_DHT_MonitorPutCB) (void *cls,
                                          const void *data,
                                          size_t size);
 
+/**
+ * Options for monitoring.
+ */
+enum GNUNET_DHT_MonitorOption
+{
+  /**
+   * Default.  Report everything.
+   */
+  GNUNET_DHT_MO_NONE = 0,
+
+  /**
+   * Only report the headers of the messages: paths and payloads are
+   * not sent by the service and given to the callbacks with a length
+   * of zero.
+   */
+  GNUNET_DHT_MO_HEADER_ONLY = 1
+};
+
+
+/**
+ * Start monitoring the local DHT service, only being told about a
+ * sample of the messages.
+ *
+ * @param handle Handle to the DHT service.
+ * @param type Type of blocks that are of interest.
+ * @param key Key of data of interest, NULL for all.
+ * @param sample_rate report only one in @a sample_rate matching
+ *        messages of each kind, 0 or 1 for all
+ * @param options what to report
+ * @param get_cb Callback to process monitored get messages.
+ * @param get_resp_cb Callback to process monitored get response messages.
+ * @param put_cb Callback to process monitored put messages.
+ * @param cb_cls Closure for callbacks
+ * @return Handle to stop monitoring.
+ */
+struct GNUNET_DHT_MonitorHandle *
+GNUNET_DHT_monitor_start_sampled (struct GNUNET_DHT_Handle *handle,
+                                  enum GNUNET_BLOCK_Type type,
+                                  const struct GNUNET_HashCode *key,
+                                  uint32_t sample_rate,
+                                  enum GNUNET_DHT_MonitorOption options,
+                                  GNUNET_DHT_MonitorGetCB get_cb,
+                                  GNUNET_DHT_MonitorGetRespCB get_resp_cb,
+                                  GNUNET_DHT_MonitorPutCB put_cb,
+                                  void *cb_cls);
+
+
 /**
  * Start monitoring the local DHT service.
  *
@@ -606,6 +606,38 @@ GNUNET_DISK_file_write (const struct GNUNET_DISK_FileHandle *h,
                         size_t n);
 
 
+/**
+ * Write data from several buffers with a single call.  The
+ * buffers are written in order, as if they were one contiguous
+ * buffer.
+ *
+ * @param h handle to open file
+ * @param buffers data to write
+ * @param lengths number of bytes in each of the @a buffers
+ * @param count number of entries in @a buffers and @a lengths
+ * @return number of bytes written on success, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_DISK_file_writev (const struct GNUNET_DISK_FileHandle *h,
+                         const void *const *buffers,
+                         const size_t *lengths,
+                         unsigned int count);
+
+
+/**
+ * Ask the kernel to use a buffer of @a size bytes for the pipe
+ * of the given handle.
+ *
+ * @param h handle to either end of a pipe
+ * @param size desired capacity of the pipe in bytes
+ * @return #GNUNET_OK on success, #GNUNET_NO if not supported
+ *         on this platform, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_DISK_pipe_set_size (const struct GNUNET_DISK_FileHandle *h,
+                           size_t size);
+
+
 /**
  * Write a buffer to a file, blocking, if necessary.
  *
@@ -845,6 +877,15 @@ GNUNET_DISK_file_map (const struct GNUNET_DISK_FileHandle *h,
 int
 GNUNET_DISK_file_unmap (struct GNUNET_DISK_MapHandle *h);
 
+/**
+ * Write changes to a mapped file region to disk
+ *
+ * @param h mapping handle
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR otherwise
+ */
+int
+GNUNET_DISK_file_map_sync (const struct GNUNET_DISK_MapHandle *h);
+
 /**
  * Write file changes to disk
  * @param h handle to an open file
@@ -854,6 +895,97 @@ int
 GNUNET_DISK_file_sync (const struct GNUNET_DISK_FileHandle *h);
 
 
+/**
+ * Handle for an asynchronous disk operation.
+ */
+struct GNUNET_DISK_AsyncOperation;
+
+
+/**
+ * Function called from the scheduler when an asynchronous disk
+ * operation is done.
+ *
+ * @param cls closure
+ * @param size number of bytes transferred, -1 on error (errno is set)
+ */
+typedef void
+(*GNUNET_DISK_AsyncCallback) (void *cls,
+                              ssize_t size);
+
+
+/**
+ * Read from a file without blocking the main loop.  The read
+ * happens at @a offset in a worker thread; the file position of
+ * @a h is not changed.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param result buffer to read into, must stay valid as well
+ * @param len number of bytes to read
+ * @param offset where in the file to start reading
+ * @param cb function to call with the number of bytes read
+ *        (less than @a len only at the end of the file)
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_read_async (const struct GNUNET_DISK_FileHandle *h,
+                             void *result,
+                             size_t len,
+                             off_t offset,
+                             GNUNET_DISK_AsyncCallback cb,
+                             void *cb_cls);
+
+
+/**
+ * Write to a file without blocking the main loop.  The write
+ * happens at @a offset in a worker thread; the file position of
+ * @a h is not changed.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param buffer data to write, must stay valid as well
+ * @param n number of bytes to write
+ * @param offset where in the file to write
+ * @param cb function to call with the number of bytes written
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_write_async (const struct GNUNET_DISK_FileHandle *h,
+                              const void *buffer,
+                              size_t n,
+                              off_t offset,
+                              GNUNET_DISK_AsyncCallback cb,
+                              void *cb_cls);
+
+
+/**
+ * Write file changes to disk without blocking the main loop.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param cb function to call with 0 on success, -1 on error
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_sync_async (const struct GNUNET_DISK_FileHandle *h,
+                             GNUNET_DISK_AsyncCallback cb,
+                             void *cb_cls);
+
+
+/**
+ * Cancel an asynchronous disk operation.  Its callback will not
+ * be called.  If the operation is running right now, waits for it
+ * to finish, so that the buffer can be released afterwards.
+ *
+ * @param op operation to cancel
+ */
+void
+GNUNET_DISK_async_cancel (struct GNUNET_DISK_AsyncOperation *op);
+
+
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
 #endif
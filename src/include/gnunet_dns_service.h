@@ -92,6 +92,28 @@ enum GNUNET_DNS_Flags
 
 
 
+/**
+ * Flags for filters registered with #GNUNET_DNS_add_filter().
+ */
+enum GNUNET_DNS_FilterFlags
+{
+
+  /**
+   * No special options.
+   */
+  GNUNET_DNS_FILTER_FLAG_NONE = 0,
+
+  /**
+   * Answers this (pre-resolution) client provides for requests
+   * matching the filter may be cached by the DNS service, which will
+   * then answer identical queries itself (with decremented TTLs)
+   * until the shortest TTL in the answer expires.
+   */
+  GNUNET_DNS_FILTER_FLAG_CACHE_ANSWERS = 1
+
+};
+
+
 /**
  * Signature of a function that is called whenever the DNS service
  * encounters a DNS request and needs to do something with it.  The
@@ -174,6 +196,43 @@ GNUNET_DNS_connect (const struct GNUNET_CONFIGURATION_Handle *cfg,
 		    void *rh_cls);
 
 
+/**
+ * Restrict which requests the DNS service shows to this client.  The
+ * service evaluates the filters itself and only passes requests that
+ * match at least one of the client's filters; clients without
+ * filters see all requests.  A filter matches if all of its non-empty
+ * criteria match:
+ * - some query's name is equal to or ends with (case-insensitive,
+ *   at a label boundary) one of @a suffixes,
+ * - some query's type is in @a qtypes (this and the previous
+ *   criterion must be satisfied by the same query),
+ * - some record in the answer, authority or additional section has
+ *   a type in @a rtypes (so such filters never match requests that
+ *   have not been resolved yet).
+ * Filters are hints: a client may still be shown requests that do
+ * not match (i.e. shortly after connecting), and unparsable requests
+ * are always shown.
+ *
+ * @param dh DNS handle
+ * @param suffix_count number of entries in @a suffixes
+ * @param suffixes name suffixes (without leading dot) to match
+ * @param qtype_count number of entries in @a qtypes
+ * @param qtypes query types to match, see GNUNET_DNSPARSER_TYPE_*
+ * @param rtype_count number of entries in @a rtypes
+ * @param rtypes record types to match, see GNUNET_DNSPARSER_TYPE_*
+ * @param flags options for the filter
+ */
+void
+GNUNET_DNS_add_filter (struct GNUNET_DNS_Handle *dh,
+                       unsigned int suffix_count,
+                       const char *const *suffixes,
+                       unsigned int qtype_count,
+                       const uint16_t *qtypes,
+                       unsigned int rtype_count,
+                       const uint16_t *rtypes,
+                       enum GNUNET_DNS_FilterFlags flags);
+
+
 /**
  * Disconnect from the DNS service.
  *
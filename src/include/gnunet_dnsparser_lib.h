@@ -519,6 +519,46 @@ struct GNUNET_DNSPARSER_Packet
 };
 
 
+/**
+ * Heap chunk of an arena (internal).
+ */
+struct GNUNET_DNSPARSER_ArenaChunk;
+
+
+/**
+ * Memory arena for parsing DNS packets without individual heap
+ * allocations for every name and record.  The caller supplies the
+ * backing memory (typically a buffer on the stack), everything
+ * #GNUNET_DNSPARSER_parse_arena() decodes is carved out of it, and
+ * all of it is freed with a single #GNUNET_DNSPARSER_arena_release().
+ * Should the memory run out, the arena transparently falls back to
+ * heap chunks.  The members are private to the DNS parser.
+ */
+struct GNUNET_DNSPARSER_Arena
+{
+  /**
+   * Caller-supplied memory.
+   */
+  char *mem;
+
+  /**
+   * Number of bytes in @e mem.
+   */
+  size_t mem_size;
+
+  /**
+   * Number of bytes of @e mem already handed out.
+   */
+  size_t mem_used;
+
+  /**
+   * Heap chunks allocated after @e mem was exhausted, NULL for none.
+   */
+  struct GNUNET_DNSPARSER_ArenaChunk *overflow;
+
+};
+
+
 /**
  * Check if a label in UTF-8 format can be coded into valid IDNA.
  * This can fail if the ASCII-conversion becomes longer than 63 characters.
@@ -586,6 +626,70 @@ GNUNET_DNSPARSER_pack (const struct GNUNET_DNSPARSER_Packet *p,
 		       char **buf,
 		       size_t *buf_length);
 
+
+/**
+ * Given a DNS packet @a p, write the corresponding UDP payload
+ * directly into @a buf, without any intermediate buffers.
+ *
+ * @param p packet to pack
+ * @param buf where to write the packed message; its size is the
+ *        maximum allowed size for the resulting UDP payload
+ * @param buf_size number of bytes available in @a buf
+ * @param buf_length set to the number of bytes used in @a buf
+ * @return #GNUNET_SYSERR if @a p is invalid (or @a buf cannot even
+ *           hold a DNS header)
+ *         #GNUNET_NO if @a p was truncated (but there is still a result in @a buf)
+ *         #GNUNET_OK if @a p was packed completely into @a buf
+ */
+int
+GNUNET_DNSPARSER_pack_to_buffer (const struct GNUNET_DNSPARSER_Packet *p,
+                                 char *buf,
+                                 size_t buf_size,
+                                 size_t *buf_length);
+
+
+/**
+ * Initialize an arena for #GNUNET_DNSPARSER_parse_arena().
+ *
+ * @param arena arena to initialize
+ * @param mem memory to carve allocations from, must remain valid
+ *        until the arena is no longer used
+ * @param mem_size number of bytes in @a mem
+ */
+void
+GNUNET_DNSPARSER_arena_init (struct GNUNET_DNSPARSER_Arena *arena,
+                             void *mem,
+                             size_t mem_size);
+
+
+/**
+ * Release everything that was allocated from @a arena.  Packets
+ * parsed into the arena become invalid; the arena can be reused
+ * afterwards.
+ *
+ * @param arena arena to release
+ */
+void
+GNUNET_DNSPARSER_arena_release (struct GNUNET_DNSPARSER_Arena *arena);
+
+
+/**
+ * Parse a UDP payload of a DNS packet, allocating the packet and
+ * everything it refers to from @a arena.  The result must not be
+ * passed to #GNUNET_DNSPARSER_free_packet() or modified with heap
+ * allocations; it is released (together with everything else in
+ * the arena) by #GNUNET_DNSPARSER_arena_release().
+ *
+ * @param arena arena to allocate from
+ * @param udp_payload wire-format of the DNS packet
+ * @param udp_payload_length number of bytes in @a udp_payload
+ * @return NULL on error, otherwise the parsed packet
+ */
+struct GNUNET_DNSPARSER_Packet *
+GNUNET_DNSPARSER_parse_arena (struct GNUNET_DNSPARSER_Arena *arena,
+                              const char *udp_payload,
+                              size_t udp_payload_length);
+
 /* ***************** low-level packing API ******************** */
 
 /**
@@ -35,7 +35,7 @@
 struct GNUNET_DNSSTUB_Context;
 
 /**
- * Opaque handle to a socket doing UDP requests.
+ * Opaque handle to a pending DNS request.
  */
 struct GNUNET_DNSSTUB_RequestSocket;
 
@@ -43,7 +43,10 @@ struct GNUNET_DNSSTUB_RequestSocket;
 /**
  * Start a DNS stub resolver.
  *
- * @param dns_ip target IP address to use
+ * @param dns_ip target IP address to use, or several addresses
+ *        separated by spaces, commas or semicolons (requests are
+ *        then retransmitted to the next server if the current one
+ *        does not answer quickly, and the first reply wins)
  * @return NULL on error
  */
 struct GNUNET_DNSSTUB_Context *
@@ -51,7 +54,7 @@ GNUNET_DNSSTUB_start (const char *dns_ip);
 
 
 /**
- * Cleanup DNSSTUB resolver.
+ * Cleanup DNSSTUB resolver.  Pending requests are cancelled.
  *
  * @param ctx stub resolver to clean up
  */
@@ -60,10 +63,13 @@ GNUNET_DNSSTUB_stop (struct GNUNET_DNSSTUB_Context *ctx);
 
 
 /**
- * Function called with the result of a DNS resolution.
+ * Function called with the result of a DNS resolution.  The request
+ * handle becomes invalid once this function returns (and must not
+ * be cancelled from within it).  If no reply arrives, the function
+ * is never called; the request must then be cancelled.
  *
  * @param cls closure
- * @param rs socket that received the response
+ * @param rs request the response is for
  * @param dns dns response, never NULL
  * @param dns_len number of bytes in 'dns'
  */
@@ -83,7 +89,7 @@ typedef void (*GNUNET_DNSSTUB_ResultCallback)(void *cls,
  * @param request_len number of bytes in msg
  * @param rc function to call with result
  * @param rc_cls closure for 'rc'
- * @return socket used for the request, NULL on error
+ * @return handle for the request, NULL on error
  */
 struct GNUNET_DNSSTUB_RequestSocket *
 GNUNET_DNSSTUB_resolve (struct GNUNET_DNSSTUB_Context *ctx,
@@ -96,14 +102,15 @@ GNUNET_DNSSTUB_resolve (struct GNUNET_DNSSTUB_Context *ctx,
 
 
 /**
- * Perform DNS resolution using our default IP from init.
+ * Perform DNS resolution using the server(s) given to
+ * #GNUNET_DNSSTUB_start().
  *
  * @param ctx stub resolver to use
  * @param request DNS request to transmit
  * @param request_len number of bytes in msg
  * @param rc function to call with result
  * @param rc_cls closure for 'rc'
- * @return socket used for the request, NULL on error
+ * @return handle for the request, NULL on error
  */
 struct GNUNET_DNSSTUB_RequestSocket *
 GNUNET_DNSSTUB_resolve2 (struct GNUNET_DNSSTUB_Context *ctx,
@@ -114,7 +121,8 @@ GNUNET_DNSSTUB_resolve2 (struct GNUNET_DNSSTUB_Context *ctx,
 
 
 /**
- * Cancel DNS resolution.
+ * Cancel DNS resolution.  Must not be called once the result
+ * callback was invoked for @a rs.
  *
  * @param rs resolution to cancel
  */
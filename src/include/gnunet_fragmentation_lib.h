@@ -93,6 +93,137 @@ GNUNET_FRAGMENT_context_create (struct GNUNET_STATISTICS_Handle *stats,
                                 void *proc_cls);
 
 
+/**
+ * Congestion control state shared by all fragmentation contexts
+ * for the same peer.
+ */
+struct GNUNET_FRAGMENT_Congestion;
+
+
+/**
+ * Current state of a congestion controller, for monitoring.
+ */
+struct GNUNET_FRAGMENT_CongestionInfo
+{
+  /**
+   * Congestion window, in fragments.
+   */
+  unsigned int cwnd;
+
+  /**
+   * Slow start threshold, in fragments.
+   */
+  unsigned int ssthresh;
+
+  /**
+   * Number of fragments currently in flight.
+   */
+  unsigned int in_flight;
+
+  /**
+   * Smoothed round-trip time (including the ACK delay of the
+   * receiver).
+   */
+  struct GNUNET_TIME_Relative srtt;
+
+  /**
+   * Current retransmission timeout.
+   */
+  struct GNUNET_TIME_Relative rto;
+
+  /**
+   * Total number of fragments transmitted.
+   */
+  uint64_t fragments_sent;
+
+  /**
+   * Number of fragments that were transmitted again.
+   */
+  uint64_t fragments_retransmitted;
+
+  /**
+   * Number of fragments we considered lost.
+   */
+  uint64_t fragments_lost;
+};
+
+
+/**
+ * Create a congestion controller for the fragments sent to one peer.
+ *
+ * @return the congestion controller
+ */
+struct GNUNET_FRAGMENT_Congestion *
+GNUNET_FRAGMENT_congestion_create (void);
+
+
+/**
+ * Destroy a congestion controller.  All fragmentation contexts
+ * using it must have been destroyed before.
+ *
+ * @param cc congestion controller to destroy
+ */
+void
+GNUNET_FRAGMENT_congestion_destroy (struct GNUNET_FRAGMENT_Congestion *cc);
+
+
+/**
+ * Obtain the current state of a congestion controller.
+ *
+ * @param cc congestion controller
+ * @param[out] info where to store the state
+ */
+void
+GNUNET_FRAGMENT_congestion_get_info (const struct GNUNET_FRAGMENT_Congestion *cc,
+                                     struct GNUNET_FRAGMENT_CongestionInfo *info);
+
+
+/**
+ * Create a fragmentation context for the given message that
+ * transmits using the window of a congestion controller.  As many
+ * fragments as the window of @a cc permits are in flight at the
+ * same time, with the window shared by all contexts using @a cc.
+ * The acknowledgements are used as selective ACKs: fragments that
+ * are missing while fragments sent after them were received are
+ * retransmitted right away, others after a retransmission timeout
+ * derived from the measured round-trip time.  The wire format is
+ * the same as for #GNUNET_FRAGMENT_context_create().
+ *
+ * @param stats statistics context
+ * @param mtu the maximum message size for each fragment
+ * @param tracker bandwidth tracker to use for flow control (can be NULL)
+ * @param cc congestion controller for the receiver of @a msg
+ * @param msg the message to fragment
+ * @param proc function to call for each fragment to transmit
+ * @param proc_cls closure for @a proc
+ * @return the fragmentation context
+ */
+struct GNUNET_FRAGMENT_Context *
+GNUNET_FRAGMENT_context_create_cc (struct GNUNET_STATISTICS_Handle *stats,
+                                   uint16_t mtu,
+                                   struct GNUNET_BANDWIDTH_Tracker *tracker,
+                                   struct GNUNET_FRAGMENT_Congestion *cc,
+                                   const struct GNUNET_MessageHeader *msg,
+                                   GNUNET_FRAGMENT_MessageProcessor proc,
+                                   void *proc_cls);
+
+
+/**
+ * Set the priority of a fragmentation context that uses a
+ * congestion controller.  When the window of the controller is
+ * full, contexts with a higher priority get the room that becomes
+ * available first, and contexts with a lower priority do not
+ * transmit while a context with a higher priority is waiting.
+ *
+ * @param fc fragmentation context created with
+ *        #GNUNET_FRAGMENT_context_create_cc()
+ * @param priority new priority, 0 (the default) is the lowest
+ */
+void
+GNUNET_FRAGMENT_context_set_priority (struct GNUNET_FRAGMENT_Context *fc,
+                                      unsigned int priority);
+
+
 /**
  * Continuation to call from the 'proc' function after the fragment
  * has been transmitted (and hence the next fragment can now be
@@ -2360,6 +2360,15 @@ enum GNUNET_FS_DownloadOptions
    */
   GNUNET_FS_DOWNLOAD_NO_TEMPORARIES = 4,
 
+  /**
+   * Keep a bounded window of block requests outstanding across the
+   * whole tree instead of asking for all known blocks at once.
+   * IBLOCKs are requested first and the remaining blocks are spread
+   * over the file, so that different parts can come from different
+   * sources at the same time.
+   */
+  GNUNET_FS_DOWNLOAD_OPTION_SWARM = 8,
+
   /**
    * Internal option used to flag this download as a 'probe' for a
    * search result.  Impacts the priority with which the download is
@@ -471,6 +471,48 @@ GNUNET_GNSRECORD_query_from_public_key (const struct GNUNET_CRYPTO_EcdsaPublicKe
 					struct GNUNET_HashCode *query);
 
 
+/**
+ * Context for calculating the DHT queries of many labels in one zone.
+ */
+struct GNUNET_GNSRECORD_QueryContext;
+
+
+/**
+ * Create a context for calculating the DHT queries of labels in
+ * @a zone.  Creating it costs about as much as five calls to
+ * #GNUNET_GNSRECORD_query_from_public_key(), afterwards each query is
+ * several times cheaper; use it for zones with many labels to look
+ * up or publish.
+ *
+ * @param zone public key of the zone
+ * @return the query context
+ */
+struct GNUNET_GNSRECORD_QueryContext *
+GNUNET_GNSRECORD_query_context_create (const struct GNUNET_CRYPTO_EcdsaPublicKey *zone);
+
+
+/**
+ * Calculate the DHT query for a given @a label in the zone of @a qc.
+ *
+ * @param qc query context of the zone
+ * @param label label of the record
+ * @param query hash to use for the query
+ */
+void
+GNUNET_GNSRECORD_query_from_context (struct GNUNET_GNSRECORD_QueryContext *qc,
+                                     const char *label,
+                                     struct GNUNET_HashCode *query);
+
+
+/**
+ * Destroy a query context.
+ *
+ * @param qc context to destroy
+ */
+void
+GNUNET_GNSRECORD_query_context_destroy (struct GNUNET_GNSRECORD_QueryContext *qc);
+
+
 /**
  * Sign name and records
  *
@@ -488,6 +530,32 @@ GNUNET_GNSRECORD_block_create (const struct GNUNET_CRYPTO_EcdsaPrivateKey *key,
 			       unsigned int rd_count);
 
 
+/**
+ * Sign name and records with keys that were derived for @a label in
+ * advance, which saves the expensive key derivation if the same label
+ * is signed repeatedly.  Does not log or use the scheduler, so it may
+ * be run in the crypto offload pool.
+ *
+ * @param dkey private key derived from the zone key for @a label
+ *        using GNUNET_CRYPTO_ecdsa_private_key_derive() with context "gns"
+ * @param dpub public key of @a dkey
+ * @param zone_pub public key of the zone
+ * @param expire block expiration
+ * @param label the name for the records
+ * @param rd record data
+ * @param rd_count number of records in @a rd
+ * @return NULL on error (block too large, signing failed)
+ */
+struct GNUNET_GNSRECORD_Block *
+GNUNET_GNSRECORD_block_create_derived (const struct GNUNET_CRYPTO_EcdsaPrivateKey *dkey,
+                                       const struct GNUNET_CRYPTO_EcdsaPublicKey *dpub,
+                                       const struct GNUNET_CRYPTO_EcdsaPublicKey *zone_pub,
+                                       struct GNUNET_TIME_Absolute expire,
+                                       const char *label,
+                                       const struct GNUNET_GNSRECORD_Data *rd,
+                                       unsigned int rd_count);
+
+
 /**
  * Check if a signature is valid.  This API is used by the GNS Block
  * to validate signatures received from the network.
@@ -375,6 +375,107 @@ GNUNET_HELLO_iterate_new_addresses (const struct GNUNET_HELLO_Message *new_hello
                                     void *it_cls);
 
 
+/**
+ * A HELLO message together with a sorted index of its addresses.
+ * Lookups are logarithmic and merging or comparing two parsed
+ * HELLOs is linear in the number of addresses, which matters for
+ * HELLOs of peers with many addresses.
+ */
+struct GNUNET_HELLO_Parsed;
+
+
+/**
+ * Parse a HELLO message into a sorted index of its addresses.
+ *
+ * @param msg HELLO to parse
+ * @return NULL if @a msg is not a HELLO
+ */
+struct GNUNET_HELLO_Parsed *
+GNUNET_HELLO_parse (const struct GNUNET_HELLO_Message *msg);
+
+
+/**
+ * Free a parsed HELLO.
+ *
+ * @param parsed parsed HELLO to free
+ */
+void
+GNUNET_HELLO_parsed_destroy (struct GNUNET_HELLO_Parsed *parsed);
+
+
+/**
+ * Get the serialized form of a parsed HELLO.
+ *
+ * @param parsed parsed HELLO
+ * @return the HELLO message, valid as long as @a parsed is
+ */
+const struct GNUNET_HELLO_Message *
+GNUNET_HELLO_parsed_get_message (const struct GNUNET_HELLO_Parsed *parsed);
+
+
+/**
+ * Iterate over the addresses of a parsed HELLO, in index order.
+ *
+ * @param parsed parsed HELLO
+ * @param it iterator to call on each address, the return value
+ *        #GNUNET_SYSERR stops the iteration, others are ignored
+ * @param it_cls closure for @a it
+ */
+void
+GNUNET_HELLO_parsed_iterate (const struct GNUNET_HELLO_Parsed *parsed,
+                             GNUNET_HELLO_AddressIterator it,
+                             void *it_cls);
+
+
+/**
+ * Check if a parsed HELLO contains the given address.
+ *
+ * @param parsed parsed HELLO
+ * @param address address to look for, the peer identity is ignored
+ * @param[out] expiration set to the expiration time of the
+ *             address if it was found, can be NULL
+ * @return #GNUNET_YES if @a address is in @a parsed, #GNUNET_NO if not
+ */
+int
+GNUNET_HELLO_parsed_lookup (const struct GNUNET_HELLO_Parsed *parsed,
+                            const struct GNUNET_HELLO_Address *address,
+                            struct GNUNET_TIME_Absolute *expiration);
+
+
+/**
+ * Merge the addresses of two parsed HELLOs (which must be for the
+ * same peer).  Addresses present in both HELLOs are kept with the
+ * later expiration time.
+ *
+ * @param p1 first parsed HELLO
+ * @param p2 second parsed HELLO
+ * @return the combined HELLO, already parsed
+ */
+struct GNUNET_HELLO_Parsed *
+GNUNET_HELLO_parsed_merge (const struct GNUNET_HELLO_Parsed *p1,
+                           const struct GNUNET_HELLO_Parsed *p2);
+
+
+/**
+ * Test if two parsed HELLOs contain the same addresses.
+ * See #GNUNET_HELLO_equals().
+ *
+ * @param p1 first parsed HELLO
+ * @param p2 second parsed HELLO
+ * @param now time to use for deciding which addresses have
+ *            expired and should not be considered at all
+ * @return absolute time forever if the two HELLOs are
+ *         totally identical; smallest timestamp >= now if
+ *         they only differ in timestamps;
+ *         zero if the some addresses with expirations >= now
+ *         do not match at all
+ */
+struct GNUNET_TIME_Absolute
+GNUNET_HELLO_parsed_equals (const struct GNUNET_HELLO_Parsed *p1,
+                            const struct GNUNET_HELLO_Parsed *p2,
+                            struct GNUNET_TIME_Absolute now);
+
+
 /**
  * Get the public key from a HELLO message.
  *
@@ -191,6 +191,27 @@ typedef void
                        void *impl_state);
 
 
+/**
+ * Signature of functions implementing the batched
+ * sending functionality of a message queue.  The implementation
+ * must write all @a count messages and then call
+ * #GNUNET_MQ_impl_send_continue() once for the whole batch.
+ * The messages remain valid until then.
+ *
+ * @param mq the message queue
+ * @param msgs the messages to send, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES and with a total size
+ *        below #GNUNET_SERVER_MAX_MESSAGE_SIZE
+ * @param count number of messages in @a msgs, at least one
+ * @param impl_state state of the implementation
+ */
+typedef void
+(*GNUNET_MQ_SendBatchImpl) (struct GNUNET_MQ_Handle *mq,
+                            const struct GNUNET_MessageHeader *const *msgs,
+                            unsigned int count,
+                            void *impl_state);
+
+
 /**
  * Signature of functions implementing the
  * destruction of a message queue.
@@ -206,7 +227,8 @@ typedef void
 
 
 /**
- * Implementation function that cancels the currently sent message.
+ * Implementation function that cancels the currently sent message
+ * (or, for batched queues, the currently sent batch).
  *
  * @param mq message queue
  * @param impl_state state specific to the implementation
@@ -397,6 +419,31 @@ GNUNET_MQ_queue_for_callbacks (GNUNET_MQ_SendImpl send,
                                void *cls);
 
 
+/**
+ * Create a message queue that hands all messages that are ready to
+ * the implementation at once.  Messages given to #GNUNET_MQ_send()
+ * within the same scheduler task are flushed together, and the sent
+ * notifications of a batch are all called from a single task.
+ *
+ * @param send_batch function the implements sending messages
+ * @param destroy function that implements destroying the queue
+ * @param cancel function that implements canceling a batch
+ * @param impl_state for the queue, passed to @a send_batch, @a destroy and @a cancel
+ * @param handlers array of message handlers
+ * @param error_handler handler for read and write errors
+ * @param cls closure for message handlers and error handler
+ * @return a new message queue
+ */
+struct GNUNET_MQ_Handle *
+GNUNET_MQ_queue_for_callbacks_batched (GNUNET_MQ_SendBatchImpl send_batch,
+                                       GNUNET_MQ_DestroyImpl destroy,
+                                       GNUNET_MQ_CancelImpl cancel,
+                                       void *impl_state,
+                                       const struct GNUNET_MQ_MessageHandler *handlers,
+                                       GNUNET_MQ_ErrorHandler error_handler,
+                                       void *cls);
+
+
 /**
  * Replace the handlers of a message queue with new handlers.  Takes
  * effect immediately, even for messages that already have been
@@ -471,7 +518,8 @@ GNUNET_MQ_inject_error (struct GNUNET_MQ_Handle *mq,
 
 /**
  * Call the send implementation for the next queued message,
- * if any.
+ * if any.  For batched queues, this completes the whole batch
+ * that was passed to the #GNUNET_MQ_SendBatchImpl.
  * Only useful for implementing message queues,
  * results in undefined behavior if not used carefully.
  *
@@ -82,6 +82,25 @@ struct GNUNET_NAMESTORE_PluginFunctions
 			unsigned int rd_count,
 			const struct GNUNET_GNSRECORD_Data *rd);
 
+  /**
+   * Start a transaction; the following calls to @e store_records are
+   * made durable together by @e commit_transaction.  May be NULL if
+   * the plugin does not support transactions.
+   *
+   * @param cls closure (internal context for the plugin)
+   * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+   */
+  int (*begin_transaction) (void *cls);
+
+  /**
+   * Commit the transaction started with @e begin_transaction.  May be
+   * NULL if the plugin does not support transactions.
+   *
+   * @param cls closure (internal context for the plugin)
+   * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+   */
+  int (*commit_transaction) (void *cls);
+
   /**
    * Lookup records in the datastore for which we are the authority.
    *
@@ -116,6 +135,33 @@ struct GNUNET_NAMESTORE_PluginFunctions
 			  GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls);
 
 
+  /**
+   * Iterate over the records of a zone (or of all zones) ordered by
+   * zone and label, starting right after the given position.  Unlike
+   * @e iterate_records, which has to skip over @a offset records on
+   * every call, this lets the database seek directly to the position,
+   * so iterating over a zone costs O(n) instead of O(n^2).  May be
+   * NULL if the plugin does not support it.
+   *
+   * @param cls closure (internal context for the plugin)
+   * @param zone private key of the zone, NULL for all zones
+   * @param after_zone zone of the last record returned by the previous
+   *        call; ignored if @a zone is not NULL
+   * @param after_label label of the last record returned by the previous
+   *        call, NULL to start from the beginning
+   * @param limit maximum number of results to return to @a iter
+   * @param iter function to call with each result
+   * @param iter_cls closure for @a iter
+   * @return #GNUNET_OK if there were results, #GNUNET_NO if there were no (more) results, #GNUNET_SYSERR on error
+   */
+  int (*iterate_records_after) (void *cls,
+                                const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                                const struct GNUNET_CRYPTO_EcdsaPrivateKey *after_zone,
+                                const char *after_label,
+                                uint64_t limit,
+                                GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls);
+
+
   /**
    * Look for an existing PKEY delegation record for a given public key.
    * Returns at most one result to the iterator.
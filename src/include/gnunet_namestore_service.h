@@ -119,6 +119,52 @@ GNUNET_NAMESTORE_records_store (struct GNUNET_NAMESTORE_Handle *h,
 				void *cont_cls);
 
 
+/**
+ * A record set to store with #GNUNET_NAMESTORE_records_store_batch().
+ */
+struct GNUNET_NAMESTORE_RecordSet
+{
+  /**
+   * Label of the records.
+   */
+  const char *label;
+
+  /**
+   * Number of records in @e rd, 0 to delete all records under @e label.
+   */
+  unsigned int rd_count;
+
+  /**
+   * The records.
+   */
+  const struct GNUNET_GNSRECORD_Data *rd;
+};
+
+
+/**
+ * Store several record sets of a zone at once.  The namestore applies
+ * them in a single database transaction and signs the blocks for the
+ * namecache in parallel, which is much faster than storing the labels
+ * one by one for bulk imports.  The serialized batch must fit into a
+ * single message (64 KiB); split larger imports into several batches.
+ *
+ * @param h handle to the namestore
+ * @param pkey private key of the zone
+ * @param count number of entries in @a sets
+ * @param sets the record sets to store
+ * @param cont continuation to call when done; the status is
+ *        #GNUNET_OK if all record sets were stored
+ * @param cont_cls closure for @a cont
+ * @return handle to abort the request, NULL if the batch is too large
+ */
+struct GNUNET_NAMESTORE_QueueEntry *
+GNUNET_NAMESTORE_records_store_batch (struct GNUNET_NAMESTORE_Handle *h,
+                                      const struct GNUNET_CRYPTO_EcdsaPrivateKey *pkey,
+                                      unsigned int count,
+                                      const struct GNUNET_NAMESTORE_RecordSet *sets,
+                                      GNUNET_NAMESTORE_ContinuationWithStatus cont,
+                                      void *cont_cls);
+
 
 /**
  * Process a record that was stored in the namestore.
@@ -307,6 +307,24 @@ GNUNET_NETWORK_socket_send (const struct GNUNET_NETWORK_Handle *desc,
                             size_t length);
 
 
+/**
+ * Send data from several buffers with a single call (always
+ * non-blocking).  The buffers are sent in order, as if they
+ * were one contiguous buffer.
+ *
+ * @param desc socket
+ * @param buffers data to send
+ * @param lengths number of bytes in each of the @a buffers
+ * @param count number of entries in @a buffers and @a lengths
+ * @return number of bytes sent, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_NETWORK_socket_sendv (const struct GNUNET_NETWORK_Handle *desc,
+                             const void *const *buffers,
+                             const size_t *lengths,
+                             unsigned int count);
+
+
 /**
  * Send data to a particular destination (always non-blocking).
  * This function only works for UDP sockets.
@@ -326,6 +344,98 @@ GNUNET_NETWORK_socket_sendto (const struct GNUNET_NETWORK_Handle *desc,
                               socklen_t dest_len);
 
 
+/**
+ * A datagram for #GNUNET_NETWORK_socket_recvfrom_batch() or
+ * #GNUNET_NETWORK_socket_sendto_batch().
+ */
+struct GNUNET_NETWORK_Datagram
+{
+  /**
+   * Payload of the datagram (or buffer to receive it in).
+   */
+  void *buffer;
+
+  /**
+   * Number of bytes in @e buffer.  When receiving, the size of
+   * @e buffer on input and the size of the datagram on output.
+   */
+  size_t length;
+
+  /**
+   * Destination address when sending, source address when receiving.
+   */
+  struct sockaddr *addr;
+
+  /**
+   * Length of @e addr.  When receiving, the size of @e addr on
+   * input and the length of the source address on output.
+   */
+  socklen_t addrlen;
+
+  /**
+   * Segment size for UDP segmentation offload.  When sending, 0 to
+   * send @e buffer as one datagram, otherwise @e buffer is sent as
+   * consecutive datagrams of this size (the last one may be
+   * shorter); only allowed if #GNUNET_NETWORK_socket_udp_offload()
+   * succeeded for the socket.  When receiving, set to the size of the coalesced
+   * datagrams if the kernel merged several into @e buffer, 0 if not.
+   */
+  uint16_t segment_size;
+};
+
+
+/**
+ * Read multiple datagrams from a socket (always non-blocking), using
+ * a single system call where the platform supports it.
+ * This function only works for UDP sockets.
+ *
+ * @param desc socket
+ * @param dgrams array of datagrams to fill in
+ * @param count number of entries in @a dgrams
+ * @return number of datagrams received (at least one), or
+ *         #GNUNET_SYSERR on error (errno is set, i.e. to EAGAIN
+ *         if no datagram was pending)
+ */
+int
+GNUNET_NETWORK_socket_recvfrom_batch (const struct GNUNET_NETWORK_Handle *desc,
+                                      struct GNUNET_NETWORK_Datagram *dgrams,
+                                      unsigned int count);
+
+
+/**
+ * Send multiple datagrams (always non-blocking), using a single
+ * system call where the platform supports it.  Datagrams are sent
+ * in order; transmission stops at the first datagram that cannot
+ * be sent.  This function only works for UDP sockets.
+ *
+ * @param desc socket
+ * @param dgrams array of datagrams to send
+ * @param count number of entries in @a dgrams
+ * @return number of datagrams sent from the beginning of @a dgrams
+ *         (at least one), or #GNUNET_SYSERR if the first datagram
+ *         could not be sent (errno is set)
+ */
+int
+GNUNET_NETWORK_socket_sendto_batch (const struct GNUNET_NETWORK_Handle *desc,
+                                    const struct GNUNET_NETWORK_Datagram *dgrams,
+                                    unsigned int count);
+
+
+/**
+ * Enable UDP segmentation offload on a UDP socket, if the platform
+ * supports it.  Afterwards #GNUNET_NETWORK_socket_recvfrom_batch()
+ * may return coalesced datagrams, and
+ * #GNUNET_NETWORK_socket_sendto_batch() may be given datagrams with
+ * a non-zero segment size.
+ *
+ * @param desc socket
+ * @return #GNUNET_YES if sending with a segment size is supported,
+ *         #GNUNET_NO if not
+ */
+int
+GNUNET_NETWORK_socket_udp_offload (struct GNUNET_NETWORK_Handle *desc);
+
+
 /**
  * Set socket option
  *
@@ -369,6 +479,21 @@ int
 GNUNET_NETWORK_socket_disable_corking (struct GNUNET_NETWORK_Handle *desc);
 
 
+/**
+ * Limit the amount of data that the kernel accepts for transmission
+ * on the given TCP socket beyond what it could already send
+ * (TCP_NOTSENT_LOWAT).
+ *
+ * @param desc socket
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the option is
+ *         not supported by the platform or the socket
+ */
+int
+GNUNET_NETWORK_socket_set_notsent_lowat (struct GNUNET_NETWORK_Handle *desc,
+                                         uint32_t bytes);
+
+
 /**
  * Create a new socket.   Configure it for non-blocking IO and
  * mark it as non-inheritable to child processes (set the
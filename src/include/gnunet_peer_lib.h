@@ -109,6 +109,19 @@ const struct GNUNET_PeerIdentity *
 GNUNET_PEER_resolve2 (GNUNET_PEER_Id id);
 
 
+/**
+ * Convert an interned PID to a short string (for printing debug
+ * messages).  Unlike #GNUNET_i2s(), the string is computed only once
+ * per interned identity and the result is reentrant.
+ *
+ * @param id interned PID to convert
+ * @return short string form of the peer identity, valid as long
+ *         @a id is valid
+ */
+const char *
+GNUNET_PEER_i2s (GNUNET_PEER_Id id);
+
+
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
 #endif
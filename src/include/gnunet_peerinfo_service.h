@@ -207,6 +207,74 @@ GNUNET_PEERINFO_notify (const struct GNUNET_CONFIGURATION_Handle *cfg,
                         void *callback_cls);
 
 
+/**
+ * Options for #GNUNET_PEERINFO_notify_filtered().
+ */
+enum GNUNET_PEERINFO_NotifyOptions
+{
+  /**
+   * Public HELLOs of all peers, in full.
+   */
+  GNUNET_PEERINFO_NOTIFY_OPTION_NONE = 0,
+
+  /**
+   * Include HELLO messages for friends only.
+   */
+  GNUNET_PEERINFO_NOTIFY_OPTION_FRIEND_ONLY = 1,
+
+  /**
+   * Skip notifications without any (matching) addresses.
+   */
+  GNUNET_PEERINFO_NOTIFY_OPTION_HAS_ADDRESSES = 2,
+
+  /**
+   * After the initial notification about a peer, only deliver
+   * the addresses that are new or whose expiration was extended.
+   */
+  GNUNET_PEERINFO_NOTIFY_OPTION_DELTA = 4
+};
+
+
+/**
+ * Type of an iterator over the hosts for filtered notifications.
+ *
+ * @param cls closure
+ * @param peer id of the peer
+ * @param version version of the information about the peer,
+ *        increases with each change of its HELLOs
+ * @param hello hello message for the peer with the addresses that
+ *        passed the filters (can be NULL)
+ */
+typedef void
+(*GNUNET_PEERINFO_FilteredProcessor) (void *cls,
+                                      const struct GNUNET_PeerIdentity *peer,
+                                      uint32_t version,
+                                      const struct GNUNET_HELLO_Message *hello);
+
+
+/**
+ * Call a method whenever our known information about peers
+ * changes, restricted by filters.  Initially calls the given
+ * function for all known peers that pass the filters and then only
+ * signals changes.  With #GNUNET_PEERINFO_NOTIFY_OPTION_DELTA, the
+ * HELLOs passed for changes only contain the changed addresses.
+ *
+ * @param cfg configuration to use
+ * @param options filters to apply
+ * @param plugin only include addresses of this transport plugin,
+ *        NULL for all
+ * @param callback the method to call for each peer
+ * @param callback_cls closure for @a callback
+ * @return NULL on error
+ */
+struct GNUNET_PEERINFO_NotifyContext *
+GNUNET_PEERINFO_notify_filtered (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                                 enum GNUNET_PEERINFO_NotifyOptions options,
+                                 const char *plugin,
+                                 GNUNET_PEERINFO_FilteredProcessor callback,
+                                 void *callback_cls);
+
+
 /**
  * Stop notifying about changes.
  *
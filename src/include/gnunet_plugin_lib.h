@@ -50,6 +50,64 @@ extern "C"
 typedef void *(*GNUNET_PLUGIN_Callback) (void *arg);
 
 
+/**
+ * Entry for a plugin that was compiled into the binary instead of
+ * being loaded from a shared library.  Use #GNUNET_PLUGIN_STATIC
+ * to define and register one.
+ */
+struct GNUNET_PLUGIN_StaticPlugin
+{
+  /**
+   * This is a linked list.
+   */
+  struct GNUNET_PLUGIN_StaticPlugin *next;
+
+  /**
+   * Name of the library the plugin would otherwise be loaded from.
+   */
+  const char *library_name;
+
+  /**
+   * The "library_name_init" function of the plugin.
+   */
+  GNUNET_PLUGIN_Callback init;
+
+  /**
+   * The "library_name_done" function of the plugin.
+   */
+  GNUNET_PLUGIN_Callback done;
+};
+
+
+/**
+ * Register a compiled-in plugin.  Afterwards, #GNUNET_PLUGIN_load,
+ * #GNUNET_PLUGIN_test and #GNUNET_PLUGIN_load_all use it instead of
+ * searching for a shared library of the same name.  Usually called
+ * from a constructor defined with #GNUNET_PLUGIN_STATIC.
+ *
+ * @param sp plugin to register, must remain valid
+ */
+void
+GNUNET_PLUGIN_register_static (struct GNUNET_PLUGIN_StaticPlugin *sp);
+
+
+/**
+ * Register the plugin @a libname (which must define the functions
+ * "libname_init" and "libname_done") as compiled-in when the
+ * binary starts.
+ *
+ * @param libname name of the plugin library, without quotes
+ */
+#define GNUNET_PLUGIN_STATIC(libname) \
+  static struct GNUNET_PLUGIN_StaticPlugin libname##_static = \
+    { NULL, #libname, &libname##_init, &libname##_done }; \
+  static void __attribute__ ((constructor)) \
+  libname##_register_static (void) \
+  { \
+    GNUNET_PLUGIN_register_static (&libname##_static); \
+  }
+
+
 /**
  * Test if a plugin exists.
  *
@@ -58,6 +58,11 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_DUMMY 2
 
+/**
+ * Negotiation of shared memory on a local connection (util/connection.c).
+ */
+#define GNUNET_MESSAGE_TYPE_CONNECTION_SHM 3
+
 /*******************************************************************************
  * RESOLVER message types
  ******************************************************************************/
@@ -248,6 +253,20 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_TRANSPORT_UDP_ACK 57
 
+/*******************************************************************************
+ * Transport-UNIX message types
+ ******************************************************************************/
+
+/**
+ * Offer of a shared memory ring to a peer on the same host.
+ */
+#define GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_OFFER 58
+
+/**
+ * Acknowledgement that the offered shared memory ring is in use.
+ */
+#define GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_ACK 59
+
 /*******************************************************************************
  * Transport-TCP message types
  ******************************************************************************/
@@ -383,6 +402,16 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_CORE_CONFIRM_TYPE_MAP 89
 
+/**
+ * Encapsulation for an AEAD encrypted message between peers.
+ */
+#define GNUNET_MESSAGE_TYPE_CORE_ENCRYPTED_AEAD_MESSAGE 90
+
+/**
+ * Incremental update of the sender's type map
+ */
+#define GNUNET_MESSAGE_TYPE_CORE_DELTA_TYPE_MAP 91
+
 
 /*******************************************************************************
  * DATASTORE message types
@@ -453,6 +482,28 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_DATASTORE_DROP 103
 
+/**
+ * Message sent by datastore client to store several items at once.
+ */
+#define GNUNET_MESSAGE_TYPE_DATASTORE_PUT_BATCH 104
+
+/**
+ * Message sent by datastore client to get data for several keys.
+ */
+#define GNUNET_MESSAGE_TYPE_DATASTORE_GET_MULTI 105
+
+/**
+ * Message sent by datastore client to get several values for
+ * replication at once.
+ */
+#define GNUNET_MESSAGE_TYPE_DATASTORE_GET_REPLICATION_MULTI 106
+
+/**
+ * Message sent by datastore client to get several zero-anonymity
+ * values at once.
+ */
+#define GNUNET_MESSAGE_TYPE_DATASTORE_GET_ZERO_ANONYMITY_MULTI 107
+
 
 /*******************************************************************************
  * FS message types
@@ -620,6 +671,21 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_DHT_CLIENT_GET_RESULTS_KNOWN             156
 
+/**
+ * Client wants to store several items in DHT with one request.
+ */
+#define GNUNET_MESSAGE_TYPE_DHT_CLIENT_PUT_BATCH 157
+
+/**
+ * Peer is storing several items in DHT that share the next hop.
+ */
+#define GNUNET_MESSAGE_TYPE_DHT_P2P_PUT_BATCH 158
+
+/**
+ * Peer announces which optional DHT messages it supports.
+ */
+#define GNUNET_MESSAGE_TYPE_DHT_P2P_CAPABILITIES 159
+
 /**
  * Further X-VINE DHT messages continued from 880
  */
@@ -669,6 +735,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_STATISTICS_WATCH_VALUE 173
 
+/**
+ * Response to a STATISTICS_GET message (batch of values, each
+ * a #GNUNET_MESSAGE_TYPE_STATISTICS_VALUE message).
+ */
+#define GNUNET_MESSAGE_TYPE_STATISTICS_VALUES 174
+
 
 /*******************************************************************************
  * VPN message types
@@ -758,12 +830,30 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP 204
 
+/**
+ * Client asks VPN service to setup IPs to redirect traffic
+ * via an exit node to a set of global IP addresses.
+ */
+#define GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_IP_BATCH 205
+
+/**
+ * VPN service responds to client with the IPs to use for a
+ * batch of requested redirections.
+ */
+#define GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP_BATCH 206
+
 
 /*******************************************************************************
  * VPN-DNS message types
  ******************************************************************************/
 
 
+/**
+ * Message from client to DNS service declaring which requests
+ * the client wants to see.
+ */
+#define GNUNET_MESSAGE_TYPE_DNS_CLIENT_FILTER 210
+
 /**
  * Initial message from client to DNS service for registration.
  */
@@ -1087,6 +1177,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY 334
 
+/**
+ * Start notifying this client about changes to the known peers
+ * that pass the given filters until it disconnects.
+ */
+#define GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY_FILTERED 335
+
 /*******************************************************************************
  * ATS message types
  ******************************************************************************/
@@ -1370,6 +1466,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_TRANSPORT_REQUEST_DISCONNECT 391
 
+/**
+ * Message containing link characteristics for the transport service
+ * to emulate.
+ */
+#define GNUNET_MESSAGE_TYPE_TRANSPORT_TRAFFIC_EMULATION 392
+
 
 /*******************************************************************************
  * FS-PUBLISH-HELPER IPC Messages
@@ -1410,6 +1512,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_FS_PUBLISH_HELPER_FINISHED 426
 
+/**
+ * P2P request for several blocks at once (one FS to another via
+ * a cadet channel on the batch transfer port).
+ */
+#define GNUNET_MESSAGE_TYPE_FS_CADET_QUERY_BATCH 427
+
 
 /*******************************************************************************
  * NAMECACHE message types
@@ -1485,6 +1593,11 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_RESULT 443
 
+/**
+ * Client to service: store a batch of record sets of one zone.
+ */
+#define GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE_BATCH 444
+
 /**
  * Client to service: please start iteration; receives
  * "GNUNET_MESSAGE_TYPE_NAMESTORE_LOOKUP_NAME_RESPONSE" messages in return.
@@ -1668,11 +1781,26 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_TESTBED_BARRIER_WAIT 487
 
+/**
+ * Message sent by a controller to its parent to report the load of its host
+ */
+#define GNUNET_MESSAGE_TYPE_TESTBED_HOST_LOAD 488
+
+/**
+ * Message to connect a peer to a list of other peers in the overlay
+ */
+#define GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT 489
+
+/**
+ * Message reporting the progress of a bulk overlay connect operation
+ */
+#define GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS 490
+
 /**
  * Not really a message, but for careful checks on the testbed messages; Should
  * always be the maximum and never be used to send messages with this type
  */
-#define GNUNET_MESSAGE_TYPE_TESTBED_MAX 488
+#define GNUNET_MESSAGE_TYPE_TESTBED_MAX 491
 
 /**
  * The initialization message towards gnunet-testbed-helper
@@ -1903,6 +2031,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_SET_ITER_DONE 589
 
+/**
+ * Request for another IBF segment, sent if the
+ * IBF segments received so far can not be decoded.
+ */
+#define GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF_MORE 590
+
 /**
  * Information about the element count for intersection
  */
@@ -1934,6 +2068,12 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_SET_COPY_LAZY_CONNECT 596
 
+/**
+ * Compact filter message for intersection exchange, only sent
+ * to peers that announced support for it.
+ */
+#define GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER 597
+
 
 /*******************************************************************************
  * TESTBED LOGGER message types
@@ -2042,6 +2182,11 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_IDENTITY_DELETE 631
 
+/**
+ * Lookup a single identity by name (client->service).
+ */
+#define GNUNET_MESSAGE_TYPE_IDENTITY_LOOKUP 632
+
 
 /*******************************************************************************
  * REVOCATION message types
@@ -2169,6 +2314,11 @@ extern "C"
 
 #define GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_STATE 667
 
+/**
+ * Several message fragments in one response from the PSYCstore service.
+ */
+#define GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT_BATCH 668
+
 
 /*******************************************************************************
  * PSYC message types
@@ -2421,6 +2571,13 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_MULTICAST_MEMBERSHIP_TEST_RESULT 762
 
+/**
+ * T<->T: Relay assignment signed by the origin, sent by the origin to a
+ * member, by the member to its relay, and back to the origin if the relay
+ * is gone.
+ */
+#define GNUNET_MESSAGE_TYPE_MULTICAST_RELAY_REQUEST 763
+
 
 
 /*******************************************************************************
@@ -2515,6 +2672,17 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_SENSOR_ANOMALY_REPORT_P2P 811
 
+/**
+ * Batch of (aggregated) sensor readings sent to a collection point
+ */
+#define GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH 812
+
+/**
+ * Collection point announces that it accepts
+ * #GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH messages
+ */
+#define GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH_SUPPORTED 813
+
 
 /*******************************************************************************
  * PEERSTORE message types
@@ -2555,6 +2723,11 @@ extern "C"
  */
 #define GNUNET_MESSAGE_TYPE_PEERSTORE_WATCH_CANCEL 826
 
+/**
+ * Batch of iteration record messages
+ */
+#define GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORDS 827
+
 /*******************************************************************************
  * SOCIAL message types
  ******************************************************************************/
@@ -2766,10 +2939,30 @@ extern "C"
 
 #endif /* ENABLE_MALICIOUS */
 
+
+/*******************************************************************************
+ * SCALARPRODUCT (ECC variant) message types
+ ******************************************************************************/
+
+/**
+ * Alice -> Bob ECC session initialization
+ */
+#define GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_SESSION_INITIALIZATION 960
+
+/**
+ * Alice -> Bob ECC crypto data
+ */
+#define GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_ALICE_CRYPTODATA 961
+
+/**
+ * Bob -> Alice ECC crypto data
+ */
+#define GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_BOB_CRYPTODATA 962
+
 /*******************************************************************************/
 
 /**
- * Next available: 960
+ * Next available: 963
  */
 
 /**
@@ -93,6 +93,29 @@ struct GNUNET_PSYCSTORE_PluginFunctions
                      const struct GNUNET_MULTICAST_MessageHeader *message,
                      uint32_t psycstore_flags);
 
+  /**
+   * Begin storing a batch of message fragments.
+   *
+   * Subsequent calls to @e fragment_store are part of one
+   * transaction until @e fragment_store_end is called.
+   *
+   * @param cls Closure.
+   *
+   * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+   */
+  int
+  (*fragment_store_begin) (void *cls);
+
+  /**
+   * Commit a batch of message fragments.
+   *
+   * @param cls Closure.
+   *
+   * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+   */
+  int
+  (*fragment_store_end) (void *cls);
+
   /**
    * Set additional flags for a given message.
    *
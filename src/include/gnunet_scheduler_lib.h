@@ -537,6 +537,122 @@ GNUNET_SCHEDULER_set_select (GNUNET_SCHEDULER_select new_select,
                              void *new_select_cls);
 
 
+/**
+ * Select how the scheduler keeps track of tasks that wait for a
+ * timeout.  By default, a timer wheel with O(1) insertion and
+ * cancellation is used; tasks that time out in the same millisecond
+ * may then become ready in arbitrary order.  Tests that depend on
+ * the exact order of timeouts can switch to a sorted list.  Must
+ * not be called while delayed tasks are pending.
+ *
+ * @param new_use_wheel #GNUNET_YES to use the timer wheel (default),
+ *        #GNUNET_NO to use a sorted list
+ */
+void
+GNUNET_SCHEDULER_set_timer_wheel (int new_use_wheel);
+
+
+/**
+ * Number of buckets in the latency and run time histograms of a
+ * `struct GNUNET_SCHEDULER_Profile`.  Bucket 0 counts tasks that
+ * took less than 100 microseconds, each further bucket covers ten
+ * times the range of the previous one, the last bucket counts all
+ * tasks that took one second or longer.
+ */
+#define GNUNET_SCHEDULER_PROFILE_BUCKETS 6
+
+/**
+ * Number of slowest tasks recorded in a `struct GNUNET_SCHEDULER_Profile`.
+ */
+#define GNUNET_SCHEDULER_PROFILE_SLOWEST 10
+
+
+/**
+ * Information about a task that was run while profiling was enabled.
+ */
+struct GNUNET_SCHEDULER_TaskProfile
+{
+  /**
+   * Callback of the task.
+   */
+  GNUNET_SCHEDULER_TaskCallback callback;
+
+  /**
+   * Where the task was scheduled (symbol and offset of the caller),
+   * empty unless the scheduler was compiled with EXECINFO.
+   */
+  char location[128];
+
+  /**
+   * Priority the task ran with.
+   */
+  enum GNUNET_SCHEDULER_Priority priority;
+
+  /**
+   * How long the task waited in the ready queue.
+   */
+  struct GNUNET_TIME_Relative latency;
+
+  /**
+   * How long the task ran.
+   */
+  struct GNUNET_TIME_Relative duration;
+};
+
+
+/**
+ * Accounting for the tasks run since profiling was enabled.
+ */
+struct GNUNET_SCHEDULER_Profile
+{
+  /**
+   * Histograms of the time tasks waited in the ready queue,
+   * per priority.
+   */
+  uint64_t latency[GNUNET_SCHEDULER_PRIORITY_COUNT][GNUNET_SCHEDULER_PROFILE_BUCKETS];
+
+  /**
+   * Histograms of the time tasks ran, per priority.
+   */
+  uint64_t duration[GNUNET_SCHEDULER_PRIORITY_COUNT][GNUNET_SCHEDULER_PROFILE_BUCKETS];
+
+  /**
+   * Longest time a task waited in the ready queue, per priority.
+   */
+  struct GNUNET_TIME_Relative max_latency[GNUNET_SCHEDULER_PRIORITY_COUNT];
+
+  /**
+   * The slowest tasks, longest run time first.
+   */
+  struct GNUNET_SCHEDULER_TaskProfile slowest[GNUNET_SCHEDULER_PROFILE_SLOWEST];
+
+  /**
+   * Number of valid entries in @e slowest.
+   */
+  unsigned int slowest_count;
+};
+
+
+/**
+ * Enable or disable per-task accounting.  While enabled, the
+ * scheduler measures how long each task waits in the ready queue and
+ * how long it runs.  Enabling profiling resets the accounting.
+ *
+ * @param enable #GNUNET_YES to enable profiling, #GNUNET_NO to disable it
+ */
+void
+GNUNET_SCHEDULER_set_profiling (int enable);
+
+
+/**
+ * Obtain the accounting collected since profiling was enabled.
+ *
+ * @return NULL if profiling is disabled
+ */
+const struct GNUNET_SCHEDULER_Profile *
+GNUNET_SCHEDULER_get_profile (void);
+
+
 /** @} */ /* end of group scheduler */
 
 #if 0                           /* keep Emacsens' auto-indent happy */
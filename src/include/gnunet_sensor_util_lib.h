@@ -348,6 +348,120 @@ struct GNUNET_SENSOR_AnomalyReportMessage
 
 };
 
+/**
+ * Used to communicate the readings of several sensors over the last
+ * reporting interval to collection points (SENSORDASHBOARD service) in
+ * one message.  Followed by @e num_entries entries, each a
+ * `struct GNUNET_SENSOR_ValueBatchEntry` and its value, possibly
+ * compressed with zlib as a whole.
+ */
+struct GNUNET_SENSOR_ValueBatchMessage
+{
+
+  /**
+   * GNUNET general message header
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of entries in the batch
+   */
+  uint16_t num_entries;
+
+  /**
+   * Are the entries compressed? #GNUNET_YES / #GNUNET_NO
+   */
+  uint16_t compressed;
+
+  /**
+   * Size of the (uncompressed) entries
+   */
+  uint32_t entries_size;
+
+};
+
+/**
+ * One entry of a `struct GNUNET_SENSOR_ValueBatchMessage`
+ */
+struct GNUNET_SENSOR_ValueBatchEntry
+{
+
+  /**
+   * Hash of sensor name
+   */
+  struct GNUNET_HashCode sensorname_hash;
+
+  /**
+   * First part of sensor version number
+   */
+  uint16_t sensorversion_major;
+
+  /**
+   * Second part of sensor version number
+   */
+  uint16_t sensorversion_minor;
+
+  /**
+   * Timestamp of the first reading in the window
+   */
+  struct GNUNET_TIME_AbsoluteNBO window_start;
+
+  /**
+   * Timestamp of the last reading in the window
+   */
+  struct GNUNET_TIME_AbsoluteNBO window_end;
+
+  /**
+   * Number of readings in the window
+   */
+  uint32_t num_readings;
+
+  /**
+   * #GNUNET_YES if the value is a `struct GNUNET_SENSOR_ValueAggregate`
+   * of numeric readings, #GNUNET_NO if it is the last reading
+   */
+  uint16_t aggregated;
+
+  /**
+   * Size of the value, allocated at position 0 after this struct
+   */
+  uint16_t value_size;
+
+};
+
+/**
+ * Summary of the numeric readings of a sensor over a reporting interval
+ */
+struct GNUNET_SENSOR_ValueAggregate
+{
+
+  /**
+   * Smallest reading
+   */
+  double min;
+
+  /**
+   * Largest reading
+   */
+  double max;
+
+  /**
+   * Mean of the readings
+   */
+  double mean;
+
+  /**
+   * Median of the readings
+   */
+  double median;
+
+  /**
+   * 90th percentile of the readings
+   */
+  double percentile90;
+
+};
+
 GNUNET_NETWORK_STRUCT_END
 /**
  * Given two version numbers as major and minor, compare them.
@@ -187,6 +187,31 @@ void
 GNUNET_SERVER_stop_listening (struct GNUNET_SERVER_Handle *server);
 
 
+/**
+ * Accept offers of shared memory from clients that connect via UNIX
+ * domain sockets (see #GNUNET_CONNECTION_shm_probe_()).  Only for
+ * services whose clients always send the first message.
+ *
+ * @param server server to configure
+ */
+void
+GNUNET_SERVER_enable_shm_ (struct GNUNET_SERVER_Handle *server);
+
+
+/**
+ * Limit the number of messages processed from a client per wakeup.
+ * Once a client used up its budget, the server moves on to the next
+ * client with buffered messages; clients are served round-robin.
+ *
+ * @param server server to configure
+ * @param budget maximum number of messages per client and turn,
+ *        0 to process messages without limit (the default)
+ */
+void
+GNUNET_SERVER_set_client_budget (struct GNUNET_SERVER_Handle *server,
+                                 unsigned int budget);
+
+
 /**
  * Free resources held by this server.
  *
@@ -246,6 +271,31 @@ void
 GNUNET_SERVER_notify_transmit_ready_cancel (struct GNUNET_SERVER_TransmitHandle *th);
 
 
+/**
+ * Transmit messages to a client without copying them.  The messages
+ * must remain valid until @a cont is called or the request is
+ * cancelled using #GNUNET_SERVER_notify_transmit_ready_cancel.
+ *
+ * @param client client to transmit messages to
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up (and call
+ *        @a cont with #GNUNET_SYSERR)?
+ * @param cont function to call once the messages were transmitted
+ * @param cont_cls closure for @a cont
+ * @return non-NULL if the transmission was queued,
+ *         NULL if we are already going to notify someone else (busy)
+ */
+struct GNUNET_SERVER_TransmitHandle *
+GNUNET_SERVER_transmit_messages (struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *const *msgs,
+                                 unsigned int count,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_CONNECTION_TransmitContinuation cont,
+                                 void *cont_cls);
+
+
 /**
  * Set the 'monitor' flag on this client.  Clients which have been
  * marked as 'monitors' won't prevent the server from shutting down
@@ -557,6 +607,20 @@ int
 GNUNET_SERVER_client_disable_corking (struct GNUNET_SERVER_Client *client);
 
 
+/**
+ * Limit the amount of data that the kernel buffers for the given
+ * client beyond what it could already send, so that queued data
+ * stays with the application as long as possible.
+ *
+ * @param client handle to the client
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success
+ */
+int
+GNUNET_SERVER_client_set_notsent_lowat (struct GNUNET_SERVER_Client *client,
+                                        uint32_t bytes);
+
+
 /**
  * The tansmit context is the key datastructure for a conveniance API
  * used for transmission of complex results to the client followed
@@ -645,6 +709,47 @@ GNUNET_SERVER_transmit_context_destroy (struct GNUNET_SERVER_TransmitContext *tc
 struct GNUNET_SERVER_NotificationContext;
 
 
+/**
+ * Reference-counted message that can be queued for several clients
+ * of a notification context without copying it for each of them.
+ */
+struct GNUNET_SERVER_SharedMessage;
+
+
+/**
+ * Create a shared message of the given size.  The caller must
+ * fill in the message (including its header) via
+ * #GNUNET_SERVER_shared_message_get() before queueing it, and
+ * must drop its reference with #GNUNET_SERVER_shared_message_drop()
+ * when done.
+ *
+ * @param size total size of the message in bytes
+ * @return the shared message, with a reference count of one
+ */
+struct GNUNET_SERVER_SharedMessage *
+GNUNET_SERVER_shared_message_create (uint16_t size);
+
+
+/**
+ * Obtain the message held by a shared message.
+ *
+ * @param sm the shared message
+ * @return the message buffer
+ */
+struct GNUNET_MessageHeader *
+GNUNET_SERVER_shared_message_get (struct GNUNET_SERVER_SharedMessage *sm);
+
+
+/**
+ * Drop a reference to a shared message, freeing it once the
+ * last queue holding it has transmitted (or discarded) it.
+ *
+ * @param sm the shared message
+ */
+void
+GNUNET_SERVER_shared_message_drop (struct GNUNET_SERVER_SharedMessage *sm);
+
+
 /**
  * Create a new notification context.
  *
@@ -695,6 +800,23 @@ GNUNET_SERVER_notification_context_unicast (struct GNUNET_SERVER_NotificationCon
                                             int can_drop);
 
 
+/**
+ * Queue a shared message for a particular client without copying
+ * it; the client must have already been added to the notification
+ * context.  The caller keeps its own reference to @a sm.
+ *
+ * @param nc context to modify
+ * @param client client to transmit to
+ * @param sm message to send
+ * @param can_drop can this message be dropped due to queue length limitations
+ */
+void
+GNUNET_SERVER_notification_context_unicast_shared (struct GNUNET_SERVER_NotificationContext *nc,
+                                                   struct GNUNET_SERVER_Client *client,
+                                                   struct GNUNET_SERVER_SharedMessage *sm,
+                                                   int can_drop);
+
+
 /**
  * Send a message to all clients of this context.
  *
@@ -775,6 +897,46 @@ GNUNET_SERVER_mst_receive (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
                            int purge, int one_shot);
 
 
+/**
+ * Obtain the free space at the end of the receive buffer of the
+ * tokenizer, so that the caller can read data into it directly
+ * and then pass it to #GNUNET_SERVER_mst_receive_buffer().  This
+ * avoids copying all messages that arrive complete.
+ *
+ * @param mst tokenizer to use
+ * @param[out] size set to the number of bytes available in the buffer
+ * @return where to write the data to
+ */
+char *
+GNUNET_SERVER_mst_get_buffer (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
+                              size_t *size);
+
+
+/**
+ * Process data that was written into the buffer returned by
+ * #GNUNET_SERVER_mst_get_buffer() and call the callback for all
+ * complete messages, which are passed without copying them unless
+ * they are not properly aligned.
+ *
+ * @param mst tokenizer to use
+ * @param client_identity ID of client for which this is a buffer,
+ *        can be NULL (will be passed back to 'cb')
+ * @param size number of bytes that were written to the buffer
+ * @param purge should any excess bytes in the buffer be discarded
+ *       (i.e. for packet-based services like UDP)
+ * @param one_shot only call callback once, keep rest of message in buffer
+ * @return #GNUNET_OK if we are done processing (need more data)
+ *         #GNUNET_NO if one_shot was set and we have another message ready
+ *         #GNUNET_SYSERR if the data stream is corrupt
+ */
+int
+GNUNET_SERVER_mst_receive_buffer (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
+                                  void *client_identity,
+                                  size_t size,
+                                  int purge,
+                                  int one_shot);
+
+
 /**
  * Destroys a tokenizer.
  *
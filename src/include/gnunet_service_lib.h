@@ -41,6 +41,15 @@ extern "C"
 #include "gnunet_server_lib.h"
 
 
+/**
+ * Environment variable set by ARM for a preforked service process.
+ * Such a process loads its configuration and takes over its listen
+ * sockets, but then waits for ARM to activate it (by sending SIGCONT
+ * over the control pipe) before actually running the service.
+ */
+#define GNUNET_SERVICE_PREFORK_ENV "GNUNET_SERVICE_PREFORKED"
+
+
 /**
  * Get the list of addresses that a server for the given service
  * should bind to.
@@ -102,7 +111,14 @@ enum GNUNET_SERVICE_Options
    * Trigger a SOFT server shutdown on signals, allowing active
    * non-monitor clients to complete their transactions.
    */
-  GNUNET_SERVICE_OPTION_SOFT_SHUTDOWN = 2
+  GNUNET_SERVICE_OPTION_SOFT_SHUTDOWN = 2,
+
+  /**
+   * The service keeps no state that must be shared between its
+   * clients, so it may run as several worker processes accepting
+   * connections on the same listen sockets (see the WORKERS option).
+   */
+  GNUNET_SERVICE_OPTION_STATELESS = 4
 };
 
 
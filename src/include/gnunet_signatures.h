@@ -181,6 +181,11 @@ extern "C"
  */
 #define GNUNET_SIGNATURE_PURPOSE_GNUID_TOKEN 26
 
+/**
+ * Signature of a multicast relay assignment sent by the origin.
+ */
+#define GNUNET_SIGNATURE_PURPOSE_MULTICAST_RELAY 27
+
 
 
 #if 0                           /* keep Emacsens' auto-indent happy */
@@ -70,7 +70,9 @@ typedef int
 
 
 /**
- * Get handle for the statistics service.
+ * Get handle for the statistics service.  If the option
+ * "PROFILE_SCHEDULER" is set in the section of @a subsystem, the
+ * scheduler's per-task accounting is enabled and reported as well.
  *
  * @param subsystem name of subsystem using the service
  * @param cfg services configuration in use
@@ -211,6 +213,46 @@ GNUNET_STATISTICS_update (struct GNUNET_STATISTICS_Handle *handle,
                           int make_persistent);
 
 
+/**
+ * Suffix (followed by the upper bound of the bucket, a power of two,
+ * or "+Inf") of the statistic counting the observations of a
+ * histogram that fell into a bucket.
+ */
+#define GNUNET_STATISTICS_HISTOGRAM_BUCKET "@le="
+
+/**
+ * Suffix of the statistic with the sum of the observations of a
+ * histogram.
+ */
+#define GNUNET_STATISTICS_HISTOGRAM_SUM "@sum"
+
+/**
+ * Suffix of the statistic with the number of observations of a
+ * histogram.
+ */
+#define GNUNET_STATISTICS_HISTOGRAM_COUNT "@count"
+
+
+/**
+ * Record an observation for a histogram (i.e. latency distribution)
+ * of our subsystem.  Histograms are stored as ordinary statistics
+ * with the name @a name followed by one of the suffixes
+ * #GNUNET_STATISTICS_HISTOGRAM_BUCKET (one per power of two),
+ * #GNUNET_STATISTICS_HISTOGRAM_SUM and
+ * #GNUNET_STATISTICS_HISTOGRAM_COUNT.
+ *
+ * @param handle identification of the statistics service
+ * @param name name of the histogram
+ * @param value the observed value
+ * @param make_persistent should the histogram be kept across restarts?
+ */
+void
+GNUNET_STATISTICS_observe (struct GNUNET_STATISTICS_Handle *handle,
+                           const char *name,
+                           uint64_t value,
+                           int make_persistent);
+
+
 
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
@@ -1034,7 +1034,16 @@ enum GNUNET_TESTBED_TopologyOption
    * option with parameter 0 to disable retrying of failed overlay connect
    * operations.
    */
-  GNUNET_TESTBED_TOPOLOGY_RETRY_CNT
+  GNUNET_TESTBED_TOPOLOGY_RETRY_CNT,
+
+  /**
+   * Establish the overlay links of each peer through bulk overlay connect
+   * operations (see GNUNET_TESTBED_overlay_connect_bulk()) instead of one
+   * overlay connect operation per link.  No further arguments.  Note that
+   * no GNUNET_TESTBED_ET_CONNECT events are generated for the individual
+   * links with this option.
+   */
+  GNUNET_TESTBED_TOPOLOGY_BULK_CONNECT
 };
 
 
@@ -1098,6 +1107,55 @@ GNUNET_TESTBED_overlay_connect (void *op_cls,
                                 struct GNUNET_TESTBED_Peer *p2);
 
 
+/**
+ * Callback to report the progress of a bulk overlay connect operation.  The
+ * operation is finished when @a ncompleted and @a nfailed add up to @a ntotal
+ * or when @a emsg is not NULL.
+ *
+ * @param cls closure
+ * @param op the operation
+ * @param ncompleted the number of overlay connections established so far
+ * @param nfailed the number of overlay connections which failed so far
+ * @param ntotal the total number of overlay connections in the operation
+ * @param emsg error message if the operation failed as a whole; NULL if not
+ */
+typedef void
+(*GNUNET_TESTBED_OverlayConnectProgressCallback) (void *cls,
+                                                  struct GNUNET_TESTBED_Operation
+                                                  *op,
+                                                  unsigned int ncompleted,
+                                                  unsigned int nfailed,
+                                                  unsigned int ntotal,
+                                                  const char *emsg);
+
+
+/**
+ * All peers must have been started before calling this function.  This
+ * function obtains the HELLO of @a p1 once and asks each of the @a npeers
+ * peers in @a peers to connect to @a p1.  Instead of one event per connection
+ * the progress is reported in aggregate to @a cb.  A
+ * #GNUNET_TESTBED_ET_OPERATION_FINISHED event is generated when all
+ * connections have either been established or failed.
+ *
+ * @param op_cls closure argument to give with the operation event
+ * @param cb the callback to call with the progress of this operation
+ * @param cb_cls the closure for @a cb
+ * @param p1 the peer the other peers should connect to
+ * @param npeers the number of peers in @a peers; should not be more than a
+ *          few thousand so that the request fits into a single message
+ * @param peers the peers which should connect to @a p1
+ * @return handle to the operation, NULL if @a npeers is 0 or too large
+ */
+struct GNUNET_TESTBED_Operation *
+GNUNET_TESTBED_overlay_connect_bulk (void *op_cls,
+                                     GNUNET_TESTBED_OverlayConnectProgressCallback
+                                     cb,
+                                     void *cb_cls,
+                                     struct GNUNET_TESTBED_Peer *p1,
+                                     unsigned int npeers,
+                                     struct GNUNET_TESTBED_Peer *const *peers);
+
+
 /**
  * Callbacks of this type are called when topology configuration is completed
  *
@@ -348,6 +348,77 @@ GNUNET_TRANSPORT_set_traffic_metric (struct GNUNET_TRANSPORT_Handle *handle,
                                      struct GNUNET_TIME_Relative delay_out);
 
 
+/**
+ * Link characteristics the transport service should emulate for
+ * the traffic with a peer.
+ */
+struct GNUNET_TRANSPORT_EmulationParameters
+{
+  /**
+   * Fixed delay to add on inbound traffic.
+   */
+  struct GNUNET_TIME_Relative delay_in;
+
+  /**
+   * Fixed delay to add on outbound traffic.
+   */
+  struct GNUNET_TIME_Relative delay_out;
+
+  /**
+   * Maximum deviation from @e delay_in; the actual delay is
+   * uniformly distributed in [delay - jitter, delay + jitter].
+   */
+  struct GNUNET_TIME_Relative jitter_in;
+
+  /**
+   * Maximum deviation from @e delay_out.
+   */
+  struct GNUNET_TIME_Relative jitter_out;
+
+  /**
+   * Inbound bandwidth cap in bytes/s, 0 for no cap.
+   */
+  uint32_t bandwidth_in;
+
+  /**
+   * Outbound bandwidth cap in bytes/s, 0 for no cap.
+   */
+  uint32_t bandwidth_out;
+
+  /**
+   * Probability to drop an inbound message, in parts per million.
+   */
+  uint32_t loss_in;
+
+  /**
+   * Probability to drop an outbound message, in parts per million.
+   */
+  uint32_t loss_out;
+
+  /**
+   * #GNUNET_YES if jitter may reorder outbound messages,
+   * #GNUNET_NO to always deliver them in order.
+   */
+  int reorder;
+};
+
+
+/**
+ * Emulate the given link characteristics for the traffic with a
+ * peer.  Replaces the delays set with
+ * #GNUNET_TRANSPORT_set_traffic_metric().
+ *
+ * @param handle transport handle
+ * @param peer the peer to emulate the link to, all zeros for
+ *        the default applied to all peers without own settings
+ * @param ep link characteristics to emulate
+ */
+void
+GNUNET_TRANSPORT_set_traffic_emulation (struct GNUNET_TRANSPORT_Handle *handle,
+                                        const struct GNUNET_PeerIdentity *peer,
+                                        const struct GNUNET_TRANSPORT_EmulationParameters *ep);
+
+
 /* *************************** HELLO *************************** */
 
 
@@ -550,12 +550,12 @@ struct GNUNET_TUN_DnsCertRecord
   /**
    * Certificate type
    */
-  uint16_t cert_type;
+  uint16_t cert_type GNUNET_PACKED;
 
   /**
    * Certificate KeyTag
    */
-  uint16_t cert_tag;
+  uint16_t cert_tag GNUNET_PACKED;
 
   /**
    * Algorithm
@@ -802,6 +802,50 @@ GNUNET_TUN_calculate_tcp6_checksum (const struct GNUNET_TUN_IPv6Header *ip,
 				    const void *payload,
 				    uint16_t payload_length);
 
+/**
+ * Turn the (valid) checksum of a TCP segment into the one's
+ * complement sum over the TCP header and payload only, excluding the
+ * pseudo header, the port numbers and the checksum itself.  The
+ * result can be passed along with the segment instead of the
+ * checksum; it reveals neither addresses nor ports and allows the
+ * receiver to compute the new checksum without touching the payload.
+ *
+ * @param af address family of the addresses (AF_INET or AF_INET6)
+ * @param source_ip source address of the segment
+ * @param destination_ip destination address of the segment
+ * @param tcp TCP header with the checksum to convert
+ * @param tcp_length number of bytes in the TCP header and payload
+ * @return partial sum, never 0
+ */
+uint16_t
+GNUNET_TUN_tcp_checksum_to_partial (int af,
+                                    const void *source_ip,
+                                    const void *destination_ip,
+                                    const struct GNUNET_TUN_TcpHeader *tcp,
+                                    uint16_t tcp_length);
+
+
+/**
+ * Calculate the TCP checksum from a partial sum as produced by
+ * #GNUNET_TUN_tcp_checksum_to_partial() for the same header (except
+ * for the port numbers) and payload.
+ *
+ * @param af address family of the addresses (AF_INET or AF_INET6)
+ * @param source_ip source address of the segment
+ * @param destination_ip destination address of the segment
+ * @param tcp TCP header (initialized except for CRC)
+ * @param tcp_length number of bytes in the TCP header and payload
+ * @param partial partial sum over the header and payload
+ */
+void
+GNUNET_TUN_calculate_tcp_checksum_from_partial (int af,
+                                                const void *source_ip,
+                                                const void *destination_ip,
+                                                struct GNUNET_TUN_TcpHeader *tcp,
+                                                uint16_t tcp_length,
+                                                uint16_t partial);
+
+
 /**
  * Calculate IPv4 UDP checksum.
  *
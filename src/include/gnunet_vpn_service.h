@@ -40,6 +40,63 @@ struct GNUNET_VPN_Handle;
 struct GNUNET_VPN_RedirectionRequest;
 
 
+/**
+ * Maximum number of destinations in one call to
+ * #GNUNET_VPN_redirect_to_ip_batch().
+ */
+#define GNUNET_VPN_MAX_BATCH_SIZE 256
+
+
+/**
+ * Destination on the Internet for #GNUNET_VPN_redirect_to_ip_batch().
+ */
+struct GNUNET_VPN_IpDestination
+{
+  /**
+   * Desired address family for the returned allocation,
+   * can also be AF_UNSPEC.
+   */
+  int result_af;
+
+  /**
+   * Address family of @e addr, AF_INET or AF_INET6.
+   */
+  int addr_af;
+
+  /**
+   * Destination IP address on the Internet.
+   */
+  union
+  {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } addr;
+};
+
+
+/**
+ * IP allocated for one of the destinations of
+ * #GNUNET_VPN_redirect_to_ip_batch().
+ */
+struct GNUNET_VPN_IpAllocation
+{
+  /**
+   * Address family of @e address, AF_INET or AF_INET6;
+   * AF_UNSPEC on error.
+   */
+  int af;
+
+  /**
+   * IP address that the VPN allocated for the redirection.
+   */
+  union
+  {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } address;
+};
+
+
 /**
  * Callback invoked from the VPN service once a redirection is
  * available.  Provides the IP address that can now be used to
@@ -58,6 +115,21 @@ typedef void (*GNUNET_VPN_AllocationCallback)(void *cls,
 					      const void *address);
 
 
+/**
+ * Callback invoked from the VPN service once a batch of redirections
+ * is available.
+ *
+ * @param cls closure
+ * @param count number of entries in @a allocations, will match the
+ *              number of destinations in the request
+ * @param allocations IPs allocated for the destinations, in the
+ *              order of the request
+ */
+typedef void (*GNUNET_VPN_BatchAllocationCallback)(void *cls,
+						   unsigned int count,
+						   const struct GNUNET_VPN_IpAllocation *allocations);
+
+
 /**
  * Cancel redirection request with the service.
  *
@@ -133,6 +205,32 @@ GNUNET_VPN_redirect_to_ip (struct GNUNET_VPN_Handle *vh,
 			   void *cb_cls);
 
 
+/**
+ * Tell the VPN that forwarding to several Internet addresses via
+ * some exit node is requested, as with #GNUNET_VPN_redirect_to_ip(),
+ * but using a single round trip to the VPN service for all of them.
+ *
+ * @param vh VPN handle
+ * @param count number of entries in @a destinations, at most
+ *        #GNUNET_VPN_MAX_BATCH_SIZE
+ * @param destinations destination IP addresses on the Internet
+ * @param expiration_time at what time should the redirections expire?
+ *        (this should not impact connections that are active at that time)
+ * @param cb function to call with the IPs
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the request (means the callback won't be
+ *         invoked anymore; the mappings may or may not be established
+ *         anyway), NULL if the request was malformed
+ */
+struct GNUNET_VPN_RedirectionRequest *
+GNUNET_VPN_redirect_to_ip_batch (struct GNUNET_VPN_Handle *vh,
+				 unsigned int count,
+				 const struct GNUNET_VPN_IpDestination *destinations,
+				 struct GNUNET_TIME_Absolute expiration_time,
+				 GNUNET_VPN_BatchAllocationCallback cb,
+				 void *cb_cls);
+
+
 /**
  * Connect to the VPN service
  *
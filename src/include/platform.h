@@ -92,6 +92,9 @@
 #if HAVE_NETINET_IP_H
 #include <netinet/ip.h>         /* superset of previous */
 #endif
+#if HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
 #include <arpa/inet.h>
 #include <netinet/tcp.h>
 #include <pwd.h>
@@ -99,6 +99,12 @@ static struct GNUNET_CONTAINER_MultiHashMap *channels_in;
  */
 static struct GNUNET_CONTAINER_MultiHashMap *channels_out;
 
+/**
+ * Maximum number of members a peer sends the messages of a group to,
+ * 0 for no limit.  Further members receive them via other members.
+ */
+static unsigned long long max_fanout;
+
 /**
  * Join status of a remote peer.
  */
@@ -117,6 +123,18 @@ enum ChannelDirection
 };
 
 
+/**
+ * Message waiting to be transmitted over a CADET channel.
+ */
+struct ChannelMessage
+{
+  struct ChannelMessage *prev;
+  struct ChannelMessage *next;
+
+  /* Followed by the message */
+};
+
+
 /**
  * Context for a CADET channel.
  */
@@ -139,6 +157,16 @@ struct Channel
    */
   struct GNUNET_CADET_TransmitHandle *tmit_handle;
 
+  /**
+   * Head of messages waiting for transmission.
+   */
+  struct ChannelMessage *tmit_head;
+
+  /**
+   * Tail of messages waiting for transmission.
+   */
+  struct ChannelMessage *tmit_tail;
+
   /**
    * Public key of the target group.
    */
@@ -170,6 +198,12 @@ struct Channel
    * @see enum ChannelDirection
    */
   uint8_t direction;
+
+  /**
+   * Does the remote peer receive messages via a relay instead of this
+   * channel?  #GNUNET_YES or #GNUNET_NO
+   */
+  uint8_t is_relayed;
 };
 
 
@@ -225,6 +259,20 @@ struct Origin
    */
   struct GNUNET_CRYPTO_EddsaPrivateKey priv_key;
 
+  /**
+   * Admitted remote members in the relay tree.
+   *
+   * The first #max_fanout members receive messages from the origin,
+   * member @a i after them from member (@a i - #max_fanout) / #max_fanout.
+   * Slots of members that left are all zeros.
+   */
+  struct GNUNET_PeerIdentity *tree;
+
+  /**
+   * Number of slots in @e tree.
+   */
+  unsigned int tree_size;
+
   /**
    * Last message fragment ID sent to the group.
    */
@@ -272,6 +320,16 @@ struct Member
    */
   struct Channel *origin_channel;
 
+  /**
+   * CADET channel to the member relaying messages to us.
+   */
+  struct Channel *relay_channel;
+
+  /**
+   * Relay assignment received from the origin.
+   */
+  struct MulticastRelayRequestMessage *relay_req;
+
   /**
    * Peer identity of origin.
    */
@@ -330,6 +388,7 @@ cleanup_origin (struct Origin *orig)
 {
   struct Group *grp = &orig->grp;
   GNUNET_CONTAINER_multihashmap_remove (origins, &grp->pub_key_hash, orig);
+  GNUNET_array_grow (orig->tree, orig->tree_size, 0);
 }
 
 
@@ -357,6 +416,18 @@ cleanup_member (struct Member *mem)
     GNUNET_free (mem->join_dcsn);
     mem->join_dcsn = NULL;
   }
+  if (NULL != mem->relay_channel)
+  {
+    struct Channel *chn = mem->relay_channel;
+    mem->relay_channel = NULL;
+    chn->grp = NULL;
+    GNUNET_CADET_channel_destroy (chn->channel);
+  }
+  if (NULL != mem->relay_req)
+  {
+    GNUNET_free (mem->relay_req);
+    mem->relay_req = NULL;
+  }
   GNUNET_CONTAINER_multihashmap_remove (members, &grp->pub_key_hash, mem);
 }
 
@@ -528,44 +599,80 @@ client_send_origin (struct GNUNET_HashCode *pub_key_hash,
 }
 
 
+static void
+cadet_transmit_next (struct Channel *chn);
+
+
 /**
  * CADET is ready to transmit a message.
  */
 size_t
 cadet_notify_transmit_ready (void *cls, size_t buf_size, void *buf)
 {
+  struct Channel *chn = cls;
+  struct ChannelMessage *cm = chn->tmit_head;
+
+  chn->tmit_handle = NULL;
   if (0 == buf_size)
   {
     /* FIXME: connection closed */
     return 0;
   }
-  const struct GNUNET_MessageHeader *msg = cls;
+  const struct GNUNET_MessageHeader *msg
+    = (const struct GNUNET_MessageHeader *) &cm[1];
   uint16_t msg_size = ntohs (msg->size);
   GNUNET_assert (msg_size <= buf_size);
   memcpy (buf, msg, msg_size);
+  GNUNET_CONTAINER_DLL_remove (chn->tmit_head, chn->tmit_tail, cm);
+  GNUNET_free (cm);
+  cadet_transmit_next (chn);
   return msg_size;
 }
 
 
 /**
- * Send a message to a CADET channel.
+ * Ask CADET to transmit the next queued message of a channel.
  *
  * @param chn  Channel.
- * @param msg  Message.
  */
 static void
-cadet_send_msg (struct Channel *chn, const struct GNUNET_MessageHeader *msg)
+cadet_transmit_next (struct Channel *chn)
 {
+  if (NULL != chn->tmit_handle || NULL == chn->tmit_head)
+    return;
+
+  const struct GNUNET_MessageHeader *msg
+    = (const struct GNUNET_MessageHeader *) &chn->tmit_head[1];
   chn->tmit_handle
     = GNUNET_CADET_notify_transmit_ready (chn->channel, GNUNET_NO,
                                           GNUNET_TIME_UNIT_FOREVER_REL,
                                           ntohs (msg->size),
                                           &cadet_notify_transmit_ready,
-                                          (void *) msg);
+                                          chn);
   GNUNET_assert (NULL != chn->tmit_handle);
 }
 
 
+/**
+ * Send a message to a CADET channel.
+ *
+ * The message is copied, so the caller may free it right away.
+ *
+ * @param chn  Channel.
+ * @param msg  Message.
+ */
+static void
+cadet_send_msg (struct Channel *chn, const struct GNUNET_MessageHeader *msg)
+{
+  uint16_t msg_size = ntohs (msg->size);
+  struct ChannelMessage *cm = GNUNET_malloc (sizeof (*cm) + msg_size);
+
+  memcpy (&cm[1], msg, msg_size);
+  GNUNET_CONTAINER_DLL_insert_tail (chn->tmit_head, chn->tmit_tail, cm);
+  cadet_transmit_next (chn);
+}
+
+
 /**
  * Create new outgoing CADET channel.
  *
@@ -616,18 +723,133 @@ cadet_send_join_request (struct Member *mem)
 }
 
 
+/**
+ * Add an admitted remote member to the relay tree of an origin.
+ *
+ * @param orig  Origin.
+ * @param peer  Peer identity of the member.
+ *
+ * @return Index of the member in the tree.
+ */
+static unsigned int
+origin_tree_add (struct Origin *orig, const struct GNUNET_PeerIdentity *peer)
+{
+  static const struct GNUNET_PeerIdentity zero;
+  unsigned int i;
+  unsigned int free_slot = orig->tree_size;
+
+  for (i = 0; i < orig->tree_size; i++)
+  {
+    if (0 == memcmp (&orig->tree[i], peer, sizeof (*peer)))
+      return i;
+    if (free_slot == orig->tree_size
+        && 0 == memcmp (&orig->tree[i], &zero, sizeof (zero)))
+      free_slot = i;
+  }
+  if (free_slot == orig->tree_size)
+    GNUNET_array_grow (orig->tree, orig->tree_size, orig->tree_size + 1);
+  orig->tree[free_slot] = *peer;
+  return free_slot;
+}
+
+
+/**
+ * Remove a remote member from the relay tree of an origin.
+ *
+ * Members relayed by it fall back to receiving messages from the origin
+ * once their channel to it ends.
+ *
+ * @param orig  Origin.
+ * @param peer  Peer identity of the member.
+ */
+static void
+origin_tree_remove (struct Origin *orig, const struct GNUNET_PeerIdentity *peer)
+{
+  unsigned int i;
+
+  for (i = 0; i < orig->tree_size; i++)
+    if (0 == memcmp (&orig->tree[i], peer, sizeof (*peer)))
+      memset (&orig->tree[i], 0, sizeof (*peer));
+}
+
+
+/**
+ * Place a newly admitted remote member in the relay tree of an origin,
+ * and if it should receive messages from another member, tell it which
+ * one.
+ *
+ * @param orig  Origin.
+ * @param chn   Channel to the admitted member.
+ */
+static void
+origin_tree_place (struct Origin *orig, struct Channel *chn)
+{
+  static const struct GNUNET_PeerIdentity zero;
+  unsigned int i;
+  const struct GNUNET_PeerIdentity *relay;
+
+  if (0 == max_fanout)
+    return;
+  i = origin_tree_add (orig, &chn->peer);
+  if (i < max_fanout)
+    return;
+  relay = &orig->tree[(i - max_fanout) / max_fanout];
+  if (0 == memcmp (relay, &zero, sizeof (zero)))
+    return; /* Relay left, send messages directly. */
+
+  struct MulticastRelayRequestMessage req;
+  memset (&req, 0, sizeof (req));
+  req.header.type = htons (GNUNET_MESSAGE_TYPE_MULTICAST_RELAY_REQUEST);
+  req.header.size = htons (sizeof (req));
+  req.purpose.size = htonl (sizeof (req)
+                            - sizeof (req.header)
+                            - sizeof (req.reserved)
+                            - sizeof (req.signature));
+  req.purpose.purpose = htonl (GNUNET_SIGNATURE_PURPOSE_MULTICAST_RELAY);
+  req.group_key = orig->grp.pub_key;
+  req.member = chn->peer;
+  req.relay = *relay;
+  if (GNUNET_OK != GNUNET_CRYPTO_eddsa_sign (&orig->priv_key, &req.purpose,
+                                             &req.signature))
+  {
+    GNUNET_break (0);
+    return;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "%p Member %s of group %s is relayed by member %u.\n",
+              orig, GNUNET_i2s (&chn->peer), GNUNET_h2s (&chn->group_key_hash),
+              (i - (unsigned int) max_fanout) / (unsigned int) max_fanout);
+  chn->is_relayed = GNUNET_YES;
+  cadet_send_msg (chn, &req.header);
+}
+
+
 static int
 cadet_send_join_decision_cb (void *cls,
                              const struct GNUNET_HashCode *group_key_hash,
                              void *channel)
 {
   const struct MulticastJoinDecisionMessageHeader *hdcsn = cls;
+  const struct MulticastJoinDecisionMessage *
+    dcsn = (const struct MulticastJoinDecisionMessage *) &hdcsn[1];
   struct Channel *chn = channel;
 
   if (0 == memcmp (&hdcsn->member_key, &chn->member_key, sizeof (chn->member_key))
       && 0 == memcmp (&hdcsn->peer, &chn->peer, sizeof (chn->peer)))
   {
-    cadet_send_msg (chn, &hdcsn->header);
+    cadet_send_msg (chn, &dcsn->header);
+    if (GNUNET_YES == ntohl (dcsn->is_admitted))
+    {
+      chn->join_status = JOIN_ADMITTED;
+      struct Origin *
+        orig = GNUNET_CONTAINER_multihashmap_get (origins, group_key_hash);
+      if (NULL != orig)
+        origin_tree_place (orig, chn);
+    }
+    else
+    {
+      chn->join_status = JOIN_REFUSED;
+    }
     return GNUNET_NO;
   }
   return GNUNET_YES;
@@ -656,7 +878,7 @@ cadet_send_members_cb (void *cls, const struct GNUNET_HashCode *pub_key_hash,
 {
   const struct GNUNET_MessageHeader *msg = cls;
   struct Channel *chn = channel;
-  if (JOIN_ADMITTED == chn->join_status)
+  if (JOIN_ADMITTED == chn->join_status && GNUNET_YES != chn->is_relayed)
     cadet_send_msg (chn, msg);
   return GNUNET_YES;
 }
@@ -1092,6 +1314,8 @@ cadet_notify_channel_end (void *cls,
     return;
 
   struct Channel *chn = ctx;
+  struct ChannelMessage *cm;
+
   if (NULL != chn->grp)
   {
     if (GNUNET_NO == chn->grp->is_origin)
@@ -1099,8 +1323,31 @@ cadet_notify_channel_end (void *cls,
       struct Member *mem = (struct Member *) chn->grp;
       if (chn == mem->origin_channel)
         mem->origin_channel = NULL;
+      if (chn == mem->relay_channel)
+      { /* Relay gone, ask origin to send messages directly. */
+        mem->relay_channel = NULL;
+        if (NULL != mem->origin_channel && NULL != mem->relay_req)
+          cadet_send_msg (mem->origin_channel, &mem->relay_req->header);
+      }
     }
   }
+  if (DIR_INCOMING == chn->direction)
+  {
+    GNUNET_CONTAINER_multihashmap_remove (channels_in, &chn->group_key_hash, chn);
+    struct Origin *
+      orig = GNUNET_CONTAINER_multihashmap_get (origins, &chn->group_key_hash);
+    if (NULL != orig && JOIN_ADMITTED == chn->join_status)
+      origin_tree_remove (orig, &chn->peer);
+  }
+  else
+  {
+    GNUNET_CONTAINER_multihashmap_remove (channels_out, &chn->group_key_hash, chn);
+  }
+  while (NULL != (cm = chn->tmit_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (chn->tmit_head, chn->tmit_tail, cm);
+    GNUNET_free (cm);
+  }
   GNUNET_free (chn);
 }
 
@@ -1156,6 +1403,7 @@ cadet_recv_join_request (void *cls,
   chn->join_status = JOIN_WAITING;
   GNUNET_CONTAINER_multihashmap_put (channels_in, &chn->group_key_hash, chn,
                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  *ctx = chn;
 
   client_send_all (&group_key_hash, m);
   return GNUNET_OK;
@@ -1205,13 +1453,15 @@ cadet_recv_join_decision (void *cls,
 
   struct MulticastJoinDecisionMessageHeader *
     hdcsn = GNUNET_malloc (sizeof (*hdcsn) + size);
+  hdcsn->header.type = htons (GNUNET_MESSAGE_TYPE_MULTICAST_JOIN_DECISION);
+  hdcsn->header.size = htons (sizeof (*hdcsn) + size);
   hdcsn->peer = chn->peer;
-  memcpy (&hdcsn[1], dcsn, sizeof (*hdcsn) + size);
+  memcpy (&hdcsn[1], dcsn, size);
 
   struct Member *mem = (struct Member *) chn->grp;
   client_send_join_decision (mem, hdcsn);
   GNUNET_free (hdcsn);
-  if (GNUNET_YES == ntohs (dcsn->is_admitted))
+  if (GNUNET_YES == ntohl (dcsn->is_admitted))
   {
     chn->join_status = JOIN_ADMITTED;
     return GNUNET_OK;
@@ -1264,6 +1514,132 @@ cadet_recv_message (void *cls,
   }
 
   client_send_all (&chn->group_key_hash, m);
+  /* Relay to the members we are responsible for. */
+  cadet_send_members (&chn->group_key_hash, m);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Iterator callback for finding an admitted member client.
+ *
+ * @return #GNUNET_NO if @a member is admitted, #GNUNET_YES otherwise
+ */
+static int
+member_admitted_cb (void *cls, const struct GNUNET_HashCode *pub_key_hash,
+                    void *member)
+{
+  struct Member *mem = member;
+
+  return (NULL != mem->join_dcsn) ? GNUNET_NO : GNUNET_YES;
+}
+
+
+/**
+ * Incoming relay assignment from CADET.
+ *
+ * Received by a member from the origin, by a relay from the member it
+ * should relay to, and by the origin from a member whose relay is gone.
+ */
+int
+cadet_recv_relay_request (void *cls,
+                          struct GNUNET_CADET_Channel *channel,
+                          void **ctx,
+                          const struct GNUNET_MessageHeader *m)
+{
+  const struct MulticastRelayRequestMessage *
+    req = (const struct MulticastRelayRequestMessage *) m;
+  if (ntohs (m->size) != sizeof (*req)
+      || ntohl (req->purpose.size) != (sizeof (*req)
+                                       - sizeof (req->header)
+                                       - sizeof (req->reserved)
+                                       - sizeof (req->signature)))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_MULTICAST_RELAY,
+                                  &req->purpose, &req->signature,
+                                  &req->group_key))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+
+  struct GNUNET_HashCode group_key_hash;
+  GNUNET_CRYPTO_hash (&req->group_key, sizeof (req->group_key), &group_key_hash);
+  struct Channel *chn = *ctx;
+
+  if (NULL != chn && DIR_OUTGOING == chn->direction)
+  { /* Assignment from the origin: connect to our relay. */
+    if (NULL == chn->grp || GNUNET_NO != chn->grp->is_origin
+        || 0 != memcmp (&req->member, &this_peer, sizeof (this_peer))
+        || 0 != memcmp (&req->group_key, &chn->group_key,
+                        sizeof (req->group_key)))
+    {
+      GNUNET_break_op (0);
+      return GNUNET_SYSERR;
+    }
+    struct Member *mem = (struct Member *) chn->grp;
+    if (NULL != mem->relay_channel)
+    {
+      struct Channel *relay_chn = mem->relay_channel;
+      mem->relay_channel = NULL;
+      GNUNET_CADET_channel_destroy (relay_chn->channel);
+    }
+    if (NULL == mem->relay_req)
+      mem->relay_req = GNUNET_new (struct MulticastRelayRequestMessage);
+    *mem->relay_req = *req;
+    mem->relay_channel = cadet_channel_create (&mem->grp, &mem->relay_req->relay);
+    cadet_send_msg (mem->relay_channel, &mem->relay_req->header);
+    return GNUNET_OK;
+  }
+
+  const struct GNUNET_PeerIdentity *initiator
+    = &GNUNET_CADET_channel_get_info (channel, GNUNET_CADET_OPTION_PEER)->peer;
+  if (0 != memcmp (&req->member, initiator, sizeof (*initiator)))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+
+  if (NULL != GNUNET_CONTAINER_multihashmap_get (origins, &group_key_hash))
+  { /* The relay of a member is gone, send messages to it directly again. */
+    if (NULL == chn || JOIN_ADMITTED != chn->join_status)
+    {
+      GNUNET_break_op (0);
+      return GNUNET_SYSERR;
+    }
+    chn->is_relayed = GNUNET_NO;
+    return GNUNET_OK;
+  }
+
+  /* We are asked to relay messages to a member. */
+  if (0 != memcmp (&req->relay, &this_peer, sizeof (this_peer))
+      || GNUNET_SYSERR != GNUNET_CONTAINER_multihashmap_get_multiple (members,
+                                                                      &group_key_hash,
+                                                                      &member_admitted_cb,
+                                                                      NULL))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if (NULL == chn)
+  {
+    chn = GNUNET_new (struct Channel);
+    chn->channel = channel;
+    chn->group_key = req->group_key;
+    chn->group_key_hash = group_key_hash;
+    chn->peer = req->member;
+    GNUNET_CONTAINER_multihashmap_put (channels_in, &chn->group_key_hash, chn,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+    *ctx = chn;
+  }
+  chn->join_status = JOIN_ADMITTED;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Relaying messages of group %s to %s.\n",
+              GNUNET_h2s (&group_key_hash), GNUNET_i2s (&req->member));
   return GNUNET_OK;
 }
 
@@ -1318,8 +1694,11 @@ cadet_recv_request (void *cls,
  */
 static const struct GNUNET_CADET_MessageHandler cadet_handlers[] = {
   { &cadet_recv_join_request, GNUNET_MESSAGE_TYPE_MULTICAST_JOIN_REQUEST, 0 },
+  { &cadet_recv_join_decision, GNUNET_MESSAGE_TYPE_MULTICAST_JOIN_DECISION, 0 },
   { &cadet_recv_message, GNUNET_MESSAGE_TYPE_MULTICAST_MESSAGE, 0 },
   { &cadet_recv_request, GNUNET_MESSAGE_TYPE_MULTICAST_REQUEST, 0 },
+  { &cadet_recv_relay_request, GNUNET_MESSAGE_TYPE_MULTICAST_RELAY_REQUEST,
+    sizeof (struct MulticastRelayRequestMessage) },
   { NULL, 0, 0 }
 };
 
@@ -1338,6 +1717,11 @@ core_connected_cb  (void *cls, const struct GNUNET_PeerIdentity *my_identity)
 {
   this_peer = *my_identity;
 
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg, "multicast", "MAX_FANOUT",
+                                             &max_fanout))
+    max_fanout = 0;
+
   stats = GNUNET_STATISTICS_create ("multicast", cfg);
   origins = GNUNET_CONTAINER_multihashmap_create (1, GNUNET_YES);
   members = GNUNET_CONTAINER_multihashmap_create (1, GNUNET_YES);
@@ -76,6 +76,49 @@ struct MulticastJoinRequestMessage
 };
 
 
+/**
+ * Relay assignment: the origin tells a member which other member
+ * relays the messages of the group to it.
+ */
+struct MulticastRelayRequestMessage
+{
+  /**
+   * Type: GNUNET_MESSAGE_TYPE_MULTICAST_RELAY_REQUEST
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved;
+
+  /**
+   * Signature of the rest of the fields by the group's private key.
+   */
+  struct GNUNET_CRYPTO_EddsaSignature signature;
+
+  /**
+   * Purpose for the signature and size of the signed data.
+   */
+  struct GNUNET_CRYPTO_EccSignaturePurpose purpose;
+
+  /**
+   * Public key of the group.
+   */
+  struct GNUNET_CRYPTO_EddsaPublicKey group_key;
+
+  /**
+   * Peer identity of the member receiving messages from @e relay.
+   */
+  struct GNUNET_PeerIdentity member;
+
+  /**
+   * Peer identity of the member relaying messages to @e member.
+   */
+  struct GNUNET_PeerIdentity relay;
+};
+
+
 /**
  * Header of a join decision message sent to a peer requesting join.
  */
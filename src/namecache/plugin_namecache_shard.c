@@ -0,0 +1,991 @@
+ /*
+  * This file is part of GNUnet
+  * Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+  *
+  * GNUnet is free software; you can redistribute it and/or modify
+  * it under the terms of the GNU General Public License as published
+  * by the Free Software Foundation; either version 3, or (at your
+  * option) any later version.
+  *
+  * GNUnet is distributed in the hope that it will be useful, but
+  * WITHOUT ANY WARRANTY; without even the implied warranty of
+  * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  * General Public License for more details.
+  *
+  * You should have received a copy of the GNU General Public License
+  * along with GNUnet; see the file COPYING.  If not, write to the
+  * Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+  * Boston, MA 02110-1301, USA.
+  */
+
+/**
+ * @file namecache/plugin_namecache_shard.c
+ * @brief sharded in-memory namecache backend with an on-disk snapshot
+ * @author Christian Grothoff
+ *
+ * Blocks live in memory, spread over a number of hash maps ("shards")
+ * by the first bits of the query, so that no single map ever has to
+ * be rehashed in one go.  Expiration is tracked by a timing wheel:
+ * each block is linked into the slot of the tick in which it expires,
+ * and whenever the clock has moved on we only look at the slots of
+ * the ticks that passed, instead of scanning the whole cache on every
+ * operation like the flat plugin does.
+ *
+ * For warm restarts, every block cached is appended to a snapshot
+ * file.  On startup the snapshot is mapped into memory and replayed,
+ * later records for the same query replacing earlier ones and expired
+ * records being skipped.  Once the file holds much more than the
+ * live blocks, it is rewritten ("compacted") from memory.
+ */
+
+#include "platform.h"
+#include "gnunet_namecache_plugin.h"
+#include "gnunet_namecache_service.h"
+#include "gnunet_gnsrecord_lib.h"
+#include "namecache.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "namecache-shard", __VA_ARGS__)
+
+/**
+ * Default number of shards.
+ */
+#define DEFAULT_SHARDS 16
+
+/**
+ * Maximum number of shards.
+ */
+#define MAX_SHARDS 256
+
+/**
+ * Number of slots in the expiration wheel.
+ */
+#define WHEEL_SLOTS 256
+
+/**
+ * Duration of one tick of the expiration wheel.
+ */
+#define WHEEL_TICK GNUNET_TIME_UNIT_MINUTES
+
+/**
+ * Magic number at the beginning of the snapshot file ("GNSC").
+ */
+#define SNAPSHOT_MAGIC 0x474e5343
+
+/**
+ * Version of the snapshot format.
+ */
+#define SNAPSHOT_VERSION 1
+
+/**
+ * Do not bother compacting snapshots smaller than this.
+ */
+#define COMPACT_MIN_SIZE (1024 * 1024)
+
+/**
+ * Compact the snapshot once it is this many times larger than the
+ * live blocks it describes.
+ */
+#define COMPACT_FACTOR 2
+
+/**
+ * Round @a n up to a multiple of 8, the alignment of records in the
+ * snapshot.
+ */
+#define ALIGN_RECORD(n) (((n) + 7) & ~((size_t) 7))
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header at the beginning of the snapshot file.
+ */
+struct SnapshotHeader
+{
+  /**
+   * Always #SNAPSHOT_MAGIC, in NBO.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Always #SNAPSHOT_VERSION, in NBO.
+   */
+  uint32_t version GNUNET_PACKED;
+};
+
+
+/**
+ * Header of a record in the snapshot file.  Followed by the block
+ * and padding up to the next multiple of 8 bytes.
+ */
+struct SnapshotRecord
+{
+  /**
+   * Size of the block following the header, in NBO.
+   */
+  uint32_t size GNUNET_PACKED;
+
+  /**
+   * Always zero.
+   */
+  uint32_t reserved GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * A block in the cache.  The block itself follows the struct.
+ */
+struct CacheEntry
+{
+
+  /**
+   * Kept in a DLL per slot of the expiration wheel.
+   */
+  struct CacheEntry *next;
+
+  /**
+   * Kept in a DLL per slot of the expiration wheel.
+   */
+  struct CacheEntry *prev;
+
+  /**
+   * The block, points to the memory right after this struct.
+   */
+  const struct GNUNET_GNSRECORD_Block *block;
+
+  /**
+   * Hash of the derived key of the block.
+   */
+  struct GNUNET_HashCode query;
+
+  /**
+   * When does the block expire?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Tick of the expiration wheel in which the block expires.
+   */
+  uint64_t tick;
+
+  /**
+   * Number of bytes in @e block.
+   */
+  size_t block_size;
+
+};
+
+
+/**
+ * A slot of the expiration wheel.
+ */
+struct WheelSlot
+{
+  /**
+   * Head of the entries expiring in a tick mapping to this slot.
+   */
+  struct CacheEntry *head;
+
+  /**
+   * Tail of the entries expiring in a tick mapping to this slot.
+   */
+  struct CacheEntry *tail;
+};
+
+
+/**
+ * Context for all functions in this plugin.
+ */
+struct Plugin
+{
+
+  const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+  /**
+   * Snapshot filename.
+   */
+  char *fn;
+
+  /**
+   * Snapshot file, opened for appending.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Array of @e num_shards maps from queries to `struct CacheEntry`.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap **shards;
+
+  /**
+   * The expiration wheel.
+   */
+  struct WheelSlot wheel[WHEEL_SLOTS];
+
+  /**
+   * All ticks before this one have been swept from the wheel.
+   */
+  uint64_t wheel_tick;
+
+  /**
+   * Number of bytes in the snapshot file.
+   */
+  uint64_t snapshot_size;
+
+  /**
+   * Number of bytes the live entries would take in the snapshot.
+   */
+  uint64_t live_size;
+
+  /**
+   * Number of shards.
+   */
+  unsigned int num_shards;
+
+};
+
+
+/**
+ * Compute the size of a block.
+ *
+ * @param block the block
+ * @return number of bytes in @a block
+ */
+static size_t
+block_get_size (const struct GNUNET_GNSRECORD_Block *block)
+{
+  return ntohl (block->purpose.size) +
+    sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey) +
+    sizeof (struct GNUNET_CRYPTO_EcdsaSignature);
+}
+
+
+/**
+ * Compute the number of bytes a block takes in the snapshot file.
+ *
+ * @param block_size size of the block
+ * @return size of the snapshot record
+ */
+static size_t
+record_get_size (size_t block_size)
+{
+  return ALIGN_RECORD (sizeof (struct SnapshotRecord) + block_size);
+}
+
+
+/**
+ * Find the tick of the expiration wheel covering @a t.
+ *
+ * @param t a point in time
+ * @return the tick
+ */
+static uint64_t
+time_to_tick (struct GNUNET_TIME_Absolute t)
+{
+  return t.abs_value_us / WHEEL_TICK.rel_value_us;
+}
+
+
+/**
+ * Find the shard responsible for @a query.
+ *
+ * @param plugin the plugin
+ * @param query the query
+ * @return map of the shard
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *
+get_shard (struct Plugin *plugin,
+           const struct GNUNET_HashCode *query)
+{
+  return plugin->shards[query->bits[0] % plugin->num_shards];
+}
+
+
+/**
+ * Remove an entry from the cache and free it.
+ *
+ * @param plugin the plugin
+ * @param entry entry to remove
+ */
+static void
+remove_entry (struct Plugin *plugin,
+              struct CacheEntry *entry)
+{
+  struct WheelSlot *slot;
+
+  slot = &plugin->wheel[entry->tick % WHEEL_SLOTS];
+  GNUNET_CONTAINER_DLL_remove (slot->head,
+                               slot->tail,
+                               entry);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (get_shard (plugin,
+                                                                  &entry->query),
+                                                       &entry->query,
+                                                       entry));
+  plugin->live_size -= record_get_size (entry->block_size);
+  GNUNET_free (entry);
+}
+
+
+/**
+ * Remove the entries of all ticks of the expiration wheel that have
+ * passed since the last call.  Each passed tick costs one slot, and
+ * each entry looked at is either expired or belongs to a later
+ * revolution of the wheel.
+ *
+ * @param plugin the plugin
+ */
+static void
+advance_wheel (struct Plugin *plugin)
+{
+  uint64_t now_tick;
+  uint64_t tick;
+  uint64_t end;
+  struct WheelSlot *slot;
+  struct CacheEntry *entry;
+  struct CacheEntry *next;
+
+  now_tick = time_to_tick (GNUNET_TIME_absolute_get ());
+  if (now_tick <= plugin->wheel_tick)
+    return;
+  end = now_tick;
+  if (end - plugin->wheel_tick > WHEEL_SLOTS)
+    plugin->wheel_tick = end - WHEEL_SLOTS; /* one revolution is enough */
+  for (tick = plugin->wheel_tick; tick < end; tick++)
+  {
+    slot = &plugin->wheel[tick % WHEEL_SLOTS];
+    next = slot->head;
+    while (NULL != (entry = next))
+    {
+      next = entry->next;
+      if (entry->tick < now_tick)
+        remove_entry (plugin,
+                      entry);
+    }
+  }
+  plugin->wheel_tick = now_tick;
+}
+
+
+/**
+ * Add a block to the cache, replacing any block under the same query.
+ *
+ * @param plugin the plugin
+ * @param query hash of the derived key of @a block
+ * @param block the block
+ * @param block_size number of bytes in @a block
+ */
+static void
+insert_entry (struct Plugin *plugin,
+              const struct GNUNET_HashCode *query,
+              const struct GNUNET_GNSRECORD_Block *block,
+              size_t block_size)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *shard;
+  struct CacheEntry *entry;
+  struct WheelSlot *slot;
+
+  shard = get_shard (plugin, query);
+  entry = GNUNET_CONTAINER_multihashmap_get (shard,
+                                             query);
+  if (NULL != entry)
+    remove_entry (plugin,
+                  entry);
+  entry = GNUNET_malloc (sizeof (struct CacheEntry) + block_size);
+  memcpy (&entry[1], block, block_size);
+  entry->block = (const struct GNUNET_GNSRECORD_Block *) &entry[1];
+  entry->query = *query;
+  entry->block_size = block_size;
+  entry->expiration = GNUNET_TIME_absolute_ntoh (block->expiration_time);
+  entry->tick = time_to_tick (entry->expiration);
+  if (entry->tick < plugin->wheel_tick)
+    entry->tick = plugin->wheel_tick; /* swept with the next tick */
+  slot = &plugin->wheel[entry->tick % WHEEL_SLOTS];
+  GNUNET_CONTAINER_DLL_insert (slot->head,
+                               slot->tail,
+                               entry);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (shard,
+                                                    query,
+                                                    entry,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  plugin->live_size += record_get_size (block_size);
+}
+
+
+/**
+ * Write a block as a snapshot record to @a fh.
+ *
+ * @param fh file to write to
+ * @param block the block
+ * @param block_size number of bytes in @a block
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+write_record (struct GNUNET_DISK_FileHandle *fh,
+              const struct GNUNET_GNSRECORD_Block *block,
+              size_t block_size)
+{
+  size_t rsize = record_get_size (block_size);
+  struct SnapshotRecord *rec;
+  ssize_t ret;
+
+  rec = GNUNET_malloc (rsize);
+  rec->size = htonl ((uint32_t) block_size);
+  memcpy (&rec[1], block, block_size);
+  ret = GNUNET_DISK_file_write (fh, rec, rsize);
+  GNUNET_free (rec);
+  if (rsize != ret)
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Closure for #compact_entry().
+ */
+struct CompactContext
+{
+  /**
+   * File we are writing to.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Set to #GNUNET_SYSERR on write errors.
+   */
+  int ret;
+};
+
+
+/**
+ * Write an entry to the new snapshot.
+ *
+ * @param cls the `struct CompactContext`
+ * @param key the query
+ * @param value the `struct CacheEntry`
+ * @return #GNUNET_YES to continue, #GNUNET_NO on write errors
+ */
+static int
+compact_entry (void *cls,
+               const struct GNUNET_HashCode *key,
+               void *value)
+{
+  struct CompactContext *cc = cls;
+  struct CacheEntry *entry = value;
+
+  if (GNUNET_OK !=
+      write_record (cc->fh, entry->block, entry->block_size))
+  {
+    cc->ret = GNUNET_SYSERR;
+    return GNUNET_NO;
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Open the snapshot file for appending, writing the header if the
+ * file is new.
+ *
+ * @param plugin the plugin
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+open_snapshot (struct Plugin *plugin)
+{
+  struct SnapshotHeader hdr;
+  off_t size;
+
+  plugin->fh = GNUNET_DISK_file_open (plugin->fn,
+                                      GNUNET_DISK_OPEN_CREATE |
+                                      GNUNET_DISK_OPEN_WRITE |
+                                      GNUNET_DISK_OPEN_APPEND,
+                                      GNUNET_DISK_PERM_USER_WRITE |
+                                      GNUNET_DISK_PERM_USER_READ);
+  if (NULL == plugin->fh)
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Unable to open file: %s.\n"),
+         plugin->fn);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != GNUNET_DISK_file_handle_size (plugin->fh, &size))
+    size = 0;
+  if (0 == size)
+  {
+    hdr.magic = htonl (SNAPSHOT_MAGIC);
+    hdr.version = htonl (SNAPSHOT_VERSION);
+    if (sizeof (hdr) != GNUNET_DISK_file_write (plugin->fh, &hdr, sizeof (hdr)))
+    {
+      LOG (GNUNET_ERROR_TYPE_ERROR,
+           _("Unable to write file: %s.\n"),
+           plugin->fn);
+      GNUNET_DISK_file_close (plugin->fh);
+      plugin->fh = NULL;
+      return GNUNET_SYSERR;
+    }
+    size = sizeof (hdr);
+  }
+  plugin->snapshot_size = size;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Rewrite the snapshot file from the live entries.  The new snapshot
+ * is written to a temporary file which then replaces the old one, so
+ * a crash in between leaves the old snapshot intact.
+ *
+ * @param plugin the plugin
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+compact_snapshot (struct Plugin *plugin)
+{
+  struct CompactContext cc;
+  struct SnapshotHeader hdr;
+  char *tmp;
+  unsigned int i;
+
+  advance_wheel (plugin);
+  GNUNET_asprintf (&tmp, "%s.tmp", plugin->fn);
+  cc.fh = GNUNET_DISK_file_open (tmp,
+                                 GNUNET_DISK_OPEN_CREATE |
+                                 GNUNET_DISK_OPEN_TRUNCATE |
+                                 GNUNET_DISK_OPEN_WRITE,
+                                 GNUNET_DISK_PERM_USER_WRITE |
+                                 GNUNET_DISK_PERM_USER_READ);
+  if (NULL == cc.fh)
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Unable to initialize file: %s.\n"),
+         tmp);
+    GNUNET_free (tmp);
+    return GNUNET_SYSERR;
+  }
+  cc.ret = GNUNET_OK;
+  hdr.magic = htonl (SNAPSHOT_MAGIC);
+  hdr.version = htonl (SNAPSHOT_VERSION);
+  if (sizeof (hdr) != GNUNET_DISK_file_write (cc.fh, &hdr, sizeof (hdr)))
+    cc.ret = GNUNET_SYSERR;
+  for (i = 0; (GNUNET_OK == cc.ret) && (i < plugin->num_shards); i++)
+    GNUNET_CONTAINER_multihashmap_iterate (plugin->shards[i],
+                                           &compact_entry,
+                                           &cc);
+  GNUNET_DISK_file_close (cc.fh);
+  if ( (GNUNET_OK != cc.ret) ||
+       (0 != RENAME (tmp, plugin->fn)) )
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Failed to compact snapshot `%s'\n"),
+         plugin->fn);
+    if (0 != UNLINK (tmp))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                tmp);
+    GNUNET_free (tmp);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (tmp);
+  if (NULL != plugin->fh)
+  {
+    GNUNET_DISK_file_close (plugin->fh);
+    plugin->fh = NULL;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Compacted snapshot from %llu to %llu bytes\n",
+       (unsigned long long) plugin->snapshot_size,
+       (unsigned long long) (plugin->live_size + sizeof (hdr)));
+  return open_snapshot (plugin);
+}
+
+
+/**
+ * Compact the snapshot if it has grown much larger than the live
+ * entries.
+ *
+ * @param plugin the plugin
+ */
+static void
+maybe_compact_snapshot (struct Plugin *plugin)
+{
+  if (plugin->snapshot_size < COMPACT_MIN_SIZE)
+    return;
+  if (plugin->snapshot_size < COMPACT_FACTOR * plugin->live_size)
+    return;
+  (void) compact_snapshot (plugin);
+}
+
+
+/**
+ * Replay the records of a mapped snapshot into the cache.
+ *
+ * @param plugin the plugin
+ * @param data the snapshot
+ * @param size number of bytes in @a data
+ * @return #GNUNET_OK if the snapshot was fully valid,
+ *         #GNUNET_NO if it had to be cut short
+ */
+static int
+replay_snapshot (struct Plugin *plugin,
+                 const char *data,
+                 size_t size)
+{
+  const struct SnapshotHeader *hdr;
+  const struct SnapshotRecord *rec;
+  const struct GNUNET_GNSRECORD_Block *block;
+  struct GNUNET_HashCode query;
+  struct GNUNET_TIME_Absolute now;
+  size_t off;
+  size_t bsize;
+  unsigned int loaded;
+
+  if (size < sizeof (struct SnapshotHeader))
+    return GNUNET_NO;
+  hdr = (const struct SnapshotHeader *) data;
+  if ( (SNAPSHOT_MAGIC != ntohl (hdr->magic)) ||
+       (SNAPSHOT_VERSION != ntohl (hdr->version)) )
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Ignoring snapshot `%s' of unknown format\n"),
+         plugin->fn);
+    return GNUNET_NO;
+  }
+  now = GNUNET_TIME_absolute_get ();
+  loaded = 0;
+  off = sizeof (struct SnapshotHeader);
+  while (off < size)
+  {
+    if (size - off < sizeof (struct SnapshotRecord))
+      break;
+    rec = (const struct SnapshotRecord *) &data[off];
+    bsize = ntohl (rec->size);
+    if ( (bsize < sizeof (struct GNUNET_GNSRECORD_Block)) ||
+         (size - off < record_get_size (bsize)) )
+      break;
+    block = (const struct GNUNET_GNSRECORD_Block *) &rec[1];
+    if (bsize != block_get_size (block))
+      break;
+    off += record_get_size (bsize);
+    if (GNUNET_TIME_absolute_ntoh (block->expiration_time).abs_value_us <
+        now.abs_value_us)
+      continue;
+    GNUNET_CRYPTO_hash (&block->derived_key,
+                        sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
+                        &query);
+    insert_entry (plugin, &query, block, bsize);
+    loaded++;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Loaded %u blocks from snapshot `%s'\n",
+       loaded,
+       plugin->fn);
+  if (off != size)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Snapshot `%s' is truncated or corrupt after %llu bytes\n"),
+         plugin->fn,
+         (unsigned long long) off);
+    return GNUNET_NO;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Load the snapshot file (if any) into the cache.
+ *
+ * @param plugin the plugin
+ * @return #GNUNET_OK if the file can be appended to as is,
+ *         #GNUNET_NO if it must be rewritten
+ */
+static int
+load_snapshot (struct Plugin *plugin)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_DISK_MapHandle *mh;
+  const char *data;
+  off_t size;
+  int ret;
+
+  if (GNUNET_YES != GNUNET_DISK_file_test (plugin->fn))
+    return GNUNET_OK;
+  fh = GNUNET_DISK_file_open (plugin->fn,
+                              GNUNET_DISK_OPEN_READ,
+                              GNUNET_DISK_PERM_NONE);
+  if (NULL == fh)
+    return GNUNET_NO;
+  if ( (GNUNET_OK != GNUNET_DISK_file_handle_size (fh, &size)) ||
+       (0 == size) )
+  {
+    GNUNET_DISK_file_close (fh);
+    return GNUNET_NO;
+  }
+  data = GNUNET_DISK_file_map (fh,
+                               &mh,
+                               GNUNET_DISK_MAP_TYPE_READ,
+                               (size_t) size);
+  if (NULL == data)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Unable to map snapshot `%s'\n"),
+         plugin->fn);
+    GNUNET_DISK_file_close (fh);
+    return GNUNET_NO;
+  }
+  ret = replay_snapshot (plugin, data, (size_t) size);
+  GNUNET_DISK_file_unmap (mh);
+  GNUNET_DISK_file_close (fh);
+  return ret;
+}
+
+
+/**
+ * Initialize the database connections and associated
+ * data structures.
+ *
+ * @param plugin the plugin context (state for this module)
+ * @return #GNUNET_OK on success
+ */
+static int
+database_setup (struct Plugin *plugin)
+{
+  unsigned long long shards;
+  unsigned int i;
+  int ret;
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_filename (plugin->cfg, "namecache-shard",
+                                               "FILENAME", &plugin->fn))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "namecache-shard", "FILENAME");
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != GNUNET_DISK_directory_create_for_file (plugin->fn))
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (plugin->cfg, "namecache-shard",
+                                             "SHARDS", &shards))
+    shards = DEFAULT_SHARDS;
+  if ( (0 == shards) ||
+       (shards > MAX_SHARDS) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "namecache-shard", "SHARDS",
+                               _("must be between 1 and 256"));
+    return GNUNET_SYSERR;
+  }
+  plugin->num_shards = (unsigned int) shards;
+  plugin->shards = GNUNET_new_array (plugin->num_shards,
+                                     struct GNUNET_CONTAINER_MultiHashMap *);
+  for (i = 0; i < plugin->num_shards; i++)
+    plugin->shards[i] = GNUNET_CONTAINER_multihashmap_create (16,
+                                                              GNUNET_NO);
+  plugin->wheel_tick = time_to_tick (GNUNET_TIME_absolute_get ());
+  ret = load_snapshot (plugin);
+  if (GNUNET_OK != ret)
+    return compact_snapshot (plugin);
+  if (GNUNET_OK != open_snapshot (plugin))
+    return GNUNET_SYSERR;
+  maybe_compact_snapshot (plugin);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Free an entry during shutdown.  The wheel is not touched, as it
+ * goes away together with the shards.
+ *
+ * @param cls NULL
+ * @param key the query
+ * @param value the `struct CacheEntry`
+ * @return #GNUNET_YES
+ */
+static int
+free_entry (void *cls,
+            const struct GNUNET_HashCode *key,
+            void *value)
+{
+  GNUNET_free (value);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Shutdown database connection and associate data
+ * structures.
+ *
+ * @param plugin the plugin context (state for this module)
+ */
+static void
+database_shutdown (struct Plugin *plugin)
+{
+  unsigned int i;
+
+  if (NULL != plugin->fh)
+  {
+    maybe_compact_snapshot (plugin);
+    if (NULL != plugin->fh)
+    {
+      GNUNET_DISK_file_sync (plugin->fh);
+      GNUNET_DISK_file_close (plugin->fh);
+      plugin->fh = NULL;
+    }
+  }
+  if (NULL != plugin->shards)
+  {
+    for (i = 0; i < plugin->num_shards; i++)
+    {
+      GNUNET_CONTAINER_multihashmap_iterate (plugin->shards[i],
+                                             &free_entry,
+                                             NULL);
+      GNUNET_CONTAINER_multihashmap_destroy (plugin->shards[i]);
+    }
+    GNUNET_free (plugin->shards);
+    plugin->shards = NULL;
+  }
+  GNUNET_free_non_null (plugin->fn);
+  plugin->fn = NULL;
+}
+
+
+/**
+ * Cache a block in the datastore.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param block block to cache
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+namecache_cache_block (void *cls,
+                       const struct GNUNET_GNSRECORD_Block *block)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_HashCode query;
+  size_t block_size;
+
+  advance_wheel (plugin);
+  block_size = block_get_size (block);
+  if (block_size > 64 * 65536)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_CRYPTO_hash (&block->derived_key,
+                      sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
+                      &query);
+  insert_entry (plugin, &query, block, block_size);
+  if (NULL != plugin->fh)
+  {
+    if (GNUNET_OK == write_record (plugin->fh, block, block_size))
+      plugin->snapshot_size += record_get_size (block_size);
+    else
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           _("Failed to append block to snapshot `%s'\n"),
+           plugin->fn);
+    maybe_compact_snapshot (plugin);
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Caching block under derived key `%s'\n",
+       GNUNET_h2s_full (&query));
+  return GNUNET_OK;
+}
+
+
+/**
+ * Get the block for a particular zone and label in the
+ * datastore.  Will return at most one result to the iterator.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param query hash of public key derived from the zone and the label
+ * @param iter function to call with the result
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
+ */
+static int
+namecache_lookup_block (void *cls,
+                        const struct GNUNET_HashCode *query,
+                        GNUNET_NAMECACHE_BlockCallback iter, void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct CacheEntry *entry;
+
+  advance_wheel (plugin);
+  entry = GNUNET_CONTAINER_multihashmap_get (get_shard (plugin, query),
+                                             query);
+  if (NULL == entry)
+    return GNUNET_NO;
+  if (0 == GNUNET_TIME_absolute_get_remaining (entry->expiration).rel_value_us)
+  {
+    /* expired within the current tick */
+    remove_entry (plugin, entry);
+    return GNUNET_NO;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Found block under derived key `%s'\n",
+       GNUNET_h2s_full (query));
+  iter (iter_cls, entry->block);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Entry point for the plugin.
+ *
+ * @param cls the "struct GNUNET_NAMECACHE_PluginEnvironment*"
+ * @return NULL on error, otherwise the plugin context
+ */
+void *
+libgnunet_plugin_namecache_shard_init (void *cls)
+{
+  static struct Plugin plugin;
+  const struct GNUNET_CONFIGURATION_Handle *cfg = cls;
+  struct GNUNET_NAMECACHE_PluginFunctions *api;
+
+  if (NULL != plugin.cfg)
+    return NULL;                /* can only initialize once! */
+  memset (&plugin, 0, sizeof (struct Plugin));
+  plugin.cfg = cfg;
+  if (GNUNET_OK != database_setup (&plugin))
+  {
+    database_shutdown (&plugin);
+    plugin.cfg = NULL;
+    return NULL;
+  }
+  api = GNUNET_new (struct GNUNET_NAMECACHE_PluginFunctions);
+  api->cls = &plugin;
+  api->cache_block = &namecache_cache_block;
+  api->lookup_block = &namecache_lookup_block;
+  LOG (GNUNET_ERROR_TYPE_INFO,
+       _("Sharded namecache running with %u shards\n"),
+       plugin.num_shards);
+  return api;
+}
+
+
+/**
+ * Exit point from the plugin.
+ *
+ * @param cls the plugin context (as returned by "init")
+ * @return always NULL
+ */
+void *
+libgnunet_plugin_namecache_shard_done (void *cls)
+{
+  struct GNUNET_NAMECACHE_PluginFunctions *api = cls;
+  struct Plugin *plugin = api->cls;
+
+  database_shutdown (plugin);
+  plugin->cfg = NULL;
+  GNUNET_free (api);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "sharded plugin is finished\n");
+  return NULL;
+}
+
+/* end of plugin_namecache_shard.c */
@@ -36,6 +36,22 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
 
+/**
+ * How many records do we fetch from the database at once during a
+ * zone iteration?  Records are buffered until the client asks for
+ * them, so this also bounds how outdated a record handed out by an
+ * iteration can be.
+ */
+#define ITERATION_BATCH_SIZE 32
+
+/**
+ * How many derived label keys do we keep around?  Deriving the
+ * per-label signing key is an expensive elliptic curve operation;
+ * caching it makes re-signing a block for a label that was just
+ * stored (or is refreshed periodically) much cheaper.
+ */
+#define MAX_LABEL_KEYS 4096
+
 
 /**
  * A namestore client
@@ -43,6 +59,41 @@
 struct NamestoreClient;
 
 
+/**
+ * A record set fetched from the database as part of a batch,
+ * waiting to be given to the client of a zone iteration.
+ */
+struct IterationRecord
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct IterationRecord *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct IterationRecord *prev;
+
+  /**
+   * Zone the records belong to.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey zone;
+
+  /**
+   * Number of records serialized after this struct.
+   */
+  unsigned int rd_count;
+
+  /**
+   * Number of bytes of serialized records after this struct,
+   * followed by the 0-terminated label.
+   */
+  size_t rd_ser_len;
+
+};
+
+
 /**
  * A namestore iteration operation.
  */
@@ -78,9 +129,44 @@ struct ZoneIteration
    */
   uint32_t request_id;
 
+  /**
+   * Records fetched from the database but not yet given to the
+   * client.
+   */
+  struct IterationRecord *batch_head;
+
+  /**
+   * Records fetched from the database but not yet given to the
+   * client.
+   */
+  struct IterationRecord *batch_tail;
+
+  /**
+   * Zone of the last record fetched from the database.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey last_zone;
+
+  /**
+   * Label of the last record fetched from the database, NULL if
+   * we have not fetched anything yet.
+   */
+  char *last_label;
+
+  /**
+   * Number of records in the last batch.
+   */
+  unsigned int batch_size;
+
+  /**
+   * #GNUNET_YES if the last batch was short, so there is nothing
+   * more in the database.
+   */
+  int batch_exhausted;
+
   /**
    * Offset of the zone iteration used to address next result of the zone
-   * iteration in the store
+   * iteration in the store, if the plugin does not support
+   * `iterate_records_after`.
    *
    * Initialy set to 0 in handle_iteration_start
    * Incremented with by every call to handle_iteration_next
@@ -154,9 +240,21 @@ struct ZoneMonitor
    */
   struct GNUNET_SCHEDULER_Task * task;
 
+  /**
+   * Zone of the last record returned during the initial iteration.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey last_zone;
+
+  /**
+   * Label of the last record returned during the initial iteration,
+   * NULL before the first one.
+   */
+  char *last_label;
+
   /**
    * Offset of the zone iteration used to address next result of the zone
-   * iteration in the store
+   * iteration in the store, if the plugin does not support
+   * `iterate_records_after`.
    *
    * Initialy set to 0.
    * Incremented with by every call to #handle_iteration_next
@@ -166,6 +264,69 @@ struct ZoneMonitor
 };
 
 
+/**
+ * Keys derived from a zone key for a label, cached as deriving them
+ * is expensive.
+ */
+struct LabelKey
+{
+
+  /**
+   * Hash of the zone's private key and the label.
+   */
+  struct GNUNET_HashCode hc;
+
+  /**
+   * Entry in #label_key_heap, ordered by time of last use.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Private key derived from the zone key for the label.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey *dkey;
+
+  /**
+   * Public key of @e dkey.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey dpub;
+
+  /**
+   * Public key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey zone_pub;
+};
+
+
+/**
+ * A batch of record stores from a client; we respond once all blocks
+ * of the batch were written to the namecache.
+ */
+struct StoreBatch
+{
+
+  /**
+   * Client to notify about the result, NULL if the client is gone.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Client's request ID.
+   */
+  uint32_t rid;
+
+  /**
+   * Number of operations of this batch that are still pending.
+   */
+  unsigned int pending;
+
+  /**
+   * Result to return to the client; the first failure wins.
+   */
+  int result;
+};
+
+
 /**
  * Pending operation on the namecache.
  */
@@ -196,6 +357,61 @@ struct CacheOperation
    * Client's request ID.
    */
   uint32_t rid;
+
+  /**
+   * Batch this operation belongs to, NULL if it is not part of one.
+   */
+  struct StoreBatch *batch;
+
+  /**
+   * Job signing the block in the crypto offload pool, NULL once done.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Hash of the zone's private key and the label, key in #signing_map.
+   */
+  struct GNUNET_HashCode hc;
+
+  /**
+   * Private key derived for the label.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey dkey;
+
+  /**
+   * Public key of @e dkey.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey dpub;
+
+  /**
+   * Public key of the zone.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey zone_pub;
+
+  /**
+   * Expiration time of the block.
+   */
+  struct GNUNET_TIME_Absolute expire;
+
+  /**
+   * Label of the block.
+   */
+  char *label;
+
+  /**
+   * Records to put into the block, allocated together with their data.
+   */
+  struct GNUNET_GNSRECORD_Data *rd;
+
+  /**
+   * Number of entries in @e rd.
+   */
+  unsigned int rd_count;
+
+  /**
+   * The signed block, set by the worker.
+   */
+  struct GNUNET_GNSRECORD_Block *block;
 };
 
 
@@ -264,6 +480,178 @@ static struct ZoneMonitor *monitor_tail;
  */
 static struct GNUNET_SERVER_NotificationContext *monitor_nc;
 
+/**
+ * Map from hash of zone key and label to `struct LabelKey`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *label_keys;
+
+/**
+ * Heap of `struct LabelKey`, least recently used at the root.
+ */
+static struct GNUNET_CONTAINER_Heap *label_key_heap;
+
+/**
+ * Map from hash of zone key and label to the most recent
+ * `struct CacheOperation` signing a block for that label.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *signing_map;
+
+
+
+/**
+ * Free a zone iteration, including any records still buffered.
+ *
+ * @param zi zone iteration to free
+ */
+static void
+free_zone_iteration (struct ZoneIteration *zi)
+{
+  struct IterationRecord *rec;
+
+  while (NULL != (rec = zi->batch_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (zi->batch_head,
+                                 zi->batch_tail,
+                                 rec);
+    GNUNET_free (rec);
+  }
+  GNUNET_free_non_null (zi->last_label);
+  GNUNET_free (zi);
+}
+
+
+/**
+ * Free a cached label key.  The caller must have removed it from
+ * #label_key_heap already.
+ *
+ * @param lk the label key to free
+ */
+static void
+free_label_key (struct LabelKey *lk)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (label_keys,
+                                                       &lk->hc,
+                                                       lk));
+  GNUNET_free (lk->dkey);
+  GNUNET_free (lk);
+}
+
+
+/**
+ * Get the keys derived from a zone key for a label, from the cache
+ * if possible.
+ *
+ * @param zone_key private key of the zone
+ * @param hc hash of @a zone_key and @a label
+ * @param label the label
+ * @return the derived keys
+ */
+static const struct LabelKey *
+get_label_key (const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+               const struct GNUNET_HashCode *hc,
+               const char *label)
+{
+  struct LabelKey *lk;
+
+  lk = GNUNET_CONTAINER_multihashmap_get (label_keys, hc);
+  if (NULL != lk)
+  {
+    GNUNET_CONTAINER_heap_update_cost (label_key_heap,
+                                       lk->hn,
+                                       GNUNET_TIME_absolute_get ().abs_value_us);
+    return lk;
+  }
+  if (GNUNET_CONTAINER_heap_get_size (label_key_heap) >= MAX_LABEL_KEYS)
+    free_label_key (GNUNET_CONTAINER_heap_remove_root (label_key_heap));
+  lk = GNUNET_new (struct LabelKey);
+  lk->hc = *hc;
+  lk->dkey = GNUNET_CRYPTO_ecdsa_private_key_derive (zone_key,
+                                                     label,
+                                                     "gns");
+  GNUNET_CRYPTO_ecdsa_key_get_public (lk->dkey,
+                                      &lk->dpub);
+  GNUNET_CRYPTO_ecdsa_key_get_public (zone_key,
+                                      &lk->zone_pub);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (label_keys,
+                                                    &lk->hc,
+                                                    lk,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  lk->hn = GNUNET_CONTAINER_heap_insert (label_key_heap,
+                                         lk,
+                                         GNUNET_TIME_absolute_get ().abs_value_us);
+  return lk;
+}
+
+
+/**
+ * Send response to the store request to the client.
+ *
+ * @param client client to talk to
+ * @param res status of the operation
+ * @param rid client's request ID
+ */
+static void
+send_store_response (struct GNUNET_SERVER_Client *client,
+                     int res,
+                     uint32_t rid);
+
+
+/**
+ * One operation of a store batch is done.  Sends the response to the
+ * client and frees the batch once nothing is pending any more.
+ *
+ * @param batch the batch
+ * @param res result of the operation
+ */
+static void
+release_batch (struct StoreBatch *batch,
+               int res)
+{
+  if ( (GNUNET_OK != res) &&
+       (GNUNET_OK == batch->result) )
+    batch->result = res;
+  GNUNET_assert (batch->pending > 0);
+  if (0 != --batch->pending)
+    return;
+  if (NULL != batch->client)
+    send_store_response (batch->client,
+                         batch->result,
+                         batch->rid);
+  GNUNET_free (batch);
+}
+
+
+/**
+ * A cache operation is done; notify the client (or its batch) and
+ * free it.
+ *
+ * @param cop the operation
+ * @param res result of the operation
+ */
+static void
+complete_cache_operation (struct CacheOperation *cop,
+                          int res)
+{
+  GNUNET_CONTAINER_DLL_remove (cop_head,
+                               cop_tail,
+                               cop);
+  (void) GNUNET_CONTAINER_multihashmap_remove (signing_map,
+                                               &cop->hc,
+                                               cop);
+  if (NULL != cop->batch)
+    release_batch (cop->batch,
+                   res);
+  else if (NULL != cop->client)
+    send_store_response (cop->client,
+                         res,
+                         cop->rid);
+  GNUNET_free_non_null (cop->block);
+  GNUNET_free_non_null (cop->rd);
+  GNUNET_free (cop->label);
+  GNUNET_free (cop);
+}
 
 
 /**
@@ -278,6 +666,7 @@ cleanup_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   struct ZoneIteration *no;
   struct NamestoreClient *nc;
   struct CacheOperation *cop;
+  struct LabelKey *lk;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Stopping namestore service\n");
@@ -288,20 +677,43 @@ cleanup_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   }
   while (NULL != (cop = cop_head))
   {
-    GNUNET_NAMECACHE_cancel (cop->qe);
-    GNUNET_CONTAINER_DLL_remove (cop_head,
-                                 cop_tail,
-                                 cop);
-    GNUNET_free (cop);
+    if (NULL != cop->job)
+      GNUNET_CRYPTO_offload_cancel (cop->job);
+    if (NULL != cop->qe)
+      GNUNET_NAMECACHE_cancel (cop->qe);
+    if (NULL != cop->batch)
+      cop->batch->client = NULL;
+    cop->client = NULL;
+    complete_cache_operation (cop, GNUNET_SYSERR);
+  }
+  if (NULL != namecache)
+  {
+    GNUNET_NAMECACHE_disconnect (namecache);
+    namecache = NULL;
+  }
+  if (NULL != label_key_heap)
+  {
+    while (NULL != (lk = GNUNET_CONTAINER_heap_remove_root (label_key_heap)))
+      free_label_key (lk);
+    GNUNET_CONTAINER_heap_destroy (label_key_heap);
+    label_key_heap = NULL;
+  }
+  if (NULL != label_keys)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (label_keys);
+    label_keys = NULL;
+  }
+  if (NULL != signing_map)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (signing_map);
+    signing_map = NULL;
   }
-  GNUNET_NAMECACHE_disconnect (namecache);
-  namecache = NULL;
   while (NULL != (nc = client_head))
   {
     while (NULL != (no = nc->op_head))
     {
       GNUNET_CONTAINER_DLL_remove (nc->op_head, nc->op_tail, no);
-      GNUNET_free (no);
+      free_zone_iteration (no);
     }
     GNUNET_CONTAINER_DLL_remove (client_head, client_tail, nc);
     GNUNET_SERVER_client_set_user_context (nc->client, NULL);
@@ -344,7 +756,7 @@ client_disconnect_notification (void *cls,
   while (NULL != (no = nc->op_head))
   {
     GNUNET_CONTAINER_DLL_remove (nc->op_head, nc->op_tail, no);
-    GNUNET_free (no);
+    free_zone_iteration (no);
   }
   GNUNET_CONTAINER_DLL_remove (client_head, client_tail, nc);
   GNUNET_free (nc);
@@ -360,13 +772,19 @@ client_disconnect_notification (void *cls,
 	GNUNET_SCHEDULER_cancel (zm->task);
 	zm->task = NULL;
       }
+      GNUNET_free_non_null (zm->last_label);
       GNUNET_free (zm);
       break;
     }
   }
   for (cop = cop_head; NULL != cop; cop = cop->next)
+  {
     if (client == cop->client)
       cop->client = NULL;
+    if ( (NULL != cop->batch) &&
+         (client == cop->batch->client) )
+      cop->batch->client = NULL;
+  }
 }
 
 
@@ -658,23 +1076,132 @@ finish_cache_operation (void *cls,
   else
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "CACHE operation completed\n");
-  GNUNET_CONTAINER_DLL_remove (cop_head,
-                               cop_tail,
-                               cop);
-  if (NULL != cop->client)
-    send_store_response (cop->client,
-                         success,
-                         cop->rid);
-  GNUNET_free (cop);
+  cop->qe = NULL;
+  complete_cache_operation (cop,
+                            success);
+}
+
+
+/**
+ * Sign the block of a cache operation.  Runs in the crypto offload
+ * pool.
+ *
+ * @param cls the `struct CacheOperation`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the block could
+ *         not be created
+ */
+static int
+sign_block (void *cls)
+{
+  struct CacheOperation *cop = cls;
+
+  cop->block = GNUNET_GNSRECORD_block_create_derived (&cop->dkey,
+                                                      &cop->dpub,
+                                                      &cop->zone_pub,
+                                                      cop->expire,
+                                                      cop->label,
+                                                      cop->rd,
+                                                      cop->rd_count);
+  return (NULL == cop->block) ? GNUNET_SYSERR : GNUNET_OK;
+}
+
+
+/**
+ * The block of a cache operation was signed; put it into the
+ * namecache unless a more recent block for the label is already being
+ * signed.
+ *
+ * @param cls the `struct CacheOperation`
+ * @param result result of #sign_block()
+ */
+static void
+sign_block_done (void *cls,
+                 int result)
+{
+  struct CacheOperation *cop = cls;
+
+  cop->job = NULL;
+  if (GNUNET_OK != result)
+  {
+    GNUNET_break (0);
+    complete_cache_operation (cop,
+                              GNUNET_SYSERR);
+    return;
+  }
+  if (cop != GNUNET_CONTAINER_multihashmap_get (signing_map,
+                                                &cop->hc))
+  {
+    /* records were changed again while we were signing; the newer
+       block must not be overwritten by ours */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Block for label `%s' was superseded, not caching it\n",
+                cop->label);
+    complete_cache_operation (cop,
+                              GNUNET_OK);
+    return;
+  }
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (signing_map,
+                                                       &cop->hc,
+                                                       cop));
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Caching block for label `%s' with %u records in zone `%s' in namecache\n",
+              cop->label,
+              cop->rd_count,
+              GNUNET_GNSRECORD_z2s (&cop->zone_pub));
+  cop->qe = GNUNET_NAMECACHE_block_cache (namecache,
+                                          cop->block,
+                                          &finish_cache_operation,
+                                          cop);
+  GNUNET_free (cop->block);
+  cop->block = NULL;
+}
+
+
+/**
+ * Copy records into a single allocation, as done by
+ * #merge_with_nick_records().
+ *
+ * @param rd_count number of records in @a rd
+ * @param rd records to copy
+ * @return the copy, NULL if @a rd_count is zero
+ */
+static struct GNUNET_GNSRECORD_Data *
+copy_records (unsigned int rd_count,
+              const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct GNUNET_GNSRECORD_Data *res;
+  unsigned int i;
+  size_t req;
+  char *data;
+
+  if (0 == rd_count)
+    return NULL;
+  req = sizeof (struct GNUNET_GNSRECORD_Data) * rd_count;
+  for (i=0;i<rd_count;i++)
+    req += rd[i].data_size;
+  res = GNUNET_malloc (req);
+  data = (char *) &res[rd_count];
+  for (i=0;i<rd_count;i++)
+  {
+    res[i] = rd[i];
+    res[i].data = data;
+    memcpy (data, rd[i].data, rd[i].data_size);
+    data += rd[i].data_size;
+  }
+  return res;
 }
 
 
 /**
  * We just touched the plaintext information about a name in our zone;
- * refresh the corresponding (encrypted) block in the namecache.
+ * refresh the corresponding (encrypted) block in the namecache.  The
+ * block is signed in the crypto offload pool, the client is notified
+ * once it was cached.
  *
  * @param client client responsible for the request
  * @param rid request ID of the client
+ * @param batch batch the request belongs to, NULL for none
  * @param zone_key private key of the zone
  * @param name label for the records
  * @param rd_count number of records
@@ -683,58 +1210,73 @@ finish_cache_operation (void *cls,
 static void
 refresh_block (struct GNUNET_SERVER_Client *client,
                uint32_t rid,
+               struct StoreBatch *batch,
                const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
                const char *name,
                unsigned int rd_count,
                const struct GNUNET_GNSRECORD_Data *rd)
 {
-  struct GNUNET_GNSRECORD_Block *block;
   struct CacheOperation *cop;
-  struct GNUNET_CRYPTO_EcdsaPublicKey pkey;
+  struct GNUNET_HashContext *hctx;
+  const struct LabelKey *lk;
   struct GNUNET_GNSRECORD_Data *nick;
   struct GNUNET_GNSRECORD_Data *res;
   unsigned int res_count;
 
+  cop = GNUNET_new (struct CacheOperation);
+  cop->client = client;
+  cop->rid = rid;
+  cop->batch = batch;
+  if (NULL != batch)
+    batch->pending++;
   nick = get_nick_record (zone_key);
   res_count = rd_count;
-  res = (struct GNUNET_GNSRECORD_Data *) rd; /* fixme: a bit unclean... */
+  res = NULL;
   if (NULL != nick)
   {
     nick->flags = (nick->flags | GNUNET_GNSRECORD_RF_PRIVATE) ^ GNUNET_GNSRECORD_RF_PRIVATE;
-    merge_with_nick_records (nick, rd_count,rd, &res_count, &res);
+    merge_with_nick_records (nick, rd_count, rd, &res_count, &res);
     GNUNET_free (nick);
   }
-
+  else
+  {
+    res = copy_records (rd_count, rd);
+  }
   if (0 == res_count)
-    block = GNUNET_GNSRECORD_block_create (zone_key,
-                                           GNUNET_TIME_UNIT_ZERO_ABS,
-                                           name,
-                                           res, rd_count);
+    cop->expire = GNUNET_TIME_UNIT_ZERO_ABS;
   else
-    block = GNUNET_GNSRECORD_block_create (zone_key,
-                                           GNUNET_GNSRECORD_record_get_expiration_time (res_count,
-                                               res),
-                                           name,
-                                           res, res_count);
-  GNUNET_assert (NULL != block);
-  GNUNET_CRYPTO_ecdsa_key_get_public (zone_key,
-                                      &pkey);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Caching block for label `%s' with %u records in zone `%s' in namecache\n",
-              name,
-              res_count,
-              GNUNET_GNSRECORD_z2s (&pkey));
-  cop = GNUNET_new (struct CacheOperation);
-  cop->client = client;
-  cop->rid = rid;
+    cop->expire = GNUNET_GNSRECORD_record_get_expiration_time (res_count,
+                                                               res);
+  cop->rd = res;
+  cop->rd_count = res_count;
+  cop->label = GNUNET_strdup (name);
+  hctx = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   zone_key,
+                                   sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
+  GNUNET_CRYPTO_hash_context_read (hctx,
+                                   name,
+                                   strlen (name));
+  GNUNET_CRYPTO_hash_context_finish (hctx,
+                                     &cop->hc);
+  lk = get_label_key (zone_key,
+                      &cop->hc,
+                      name);
+  cop->dkey = *lk->dkey;
+  cop->dpub = lk->dpub;
+  cop->zone_pub = lk->zone_pub;
   GNUNET_CONTAINER_DLL_insert (cop_head,
                                cop_tail,
                                cop);
-  cop->qe = GNUNET_NAMECACHE_block_cache (namecache,
-                                          block,
-                                          &finish_cache_operation,
-                                          cop);
-  GNUNET_free (block);
+  /* supersedes any block for this label that is still being signed */
+  (void) GNUNET_CONTAINER_multihashmap_put (signing_map,
+                                            &cop->hc,
+                                            cop,
+                                            GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
+  cop->job = GNUNET_CRYPTO_offload (&sign_block,
+                                    cop,
+                                    &sign_block_done,
+                                    cop);
 }
 
 
@@ -905,6 +1447,104 @@ handle_record_lookup (void *cls,
 }
 
 
+/**
+ * Store a record set in the database, notify monitors and refresh
+ * the block in the namecache.
+ *
+ * @param client client that asked for the store
+ * @param rid client's request ID
+ * @param batch batch the store belongs to, NULL for none
+ * @param zone private key of the zone
+ * @param conv_name label, already converted to lowercase
+ * @param rd_count number of records in @a rd
+ * @param rd the records
+ * @return #GNUNET_OK if the records were stored and the client will
+ *         be notified once the block was cached, #GNUNET_NO if there
+ *         was nothing to delete, #GNUNET_SYSERR on database errors
+ */
+static int
+store_record_set (struct GNUNET_SERVER_Client *client,
+                  uint32_t rid,
+                  struct StoreBatch *batch,
+                  const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                  const char *conv_name,
+                  unsigned int rd_count,
+                  const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct ZoneMonitor *zm;
+  int res;
+
+  if ( (0 == rd_count) &&
+       (GNUNET_NO ==
+        GSN_database->iterate_records (GSN_database->cls,
+                                       zone, 0, NULL, 0)) )
+  {
+    /* This name does not exist, so cannot be removed */
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Name `%s' does not exist, no deletion required\n",
+                conv_name);
+    return GNUNET_NO;
+  }
+  {
+    struct GNUNET_GNSRECORD_Data rd_clean[rd_count];
+    unsigned int i;
+    unsigned int rd_clean_off;
+
+    /* remove "NICK" records, unless this is for the "+" label */
+    rd_clean_off = 0;
+    for (i=0;i<rd_count;i++)
+    {
+      rd_clean[rd_clean_off] = rd[i];
+      if ( (0 == strcmp (GNUNET_GNS_MASTERZONE_STR,
+                         conv_name)) ||
+           (GNUNET_GNSRECORD_TYPE_NICK != rd[i].record_type) )
+        rd_clean_off++;
+    }
+    res = GSN_database->store_records (GSN_database->cls,
+                                       zone,
+                                       conv_name,
+                                       rd_clean_off, rd_clean);
+  }
+  if (GNUNET_OK != res)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Error storing record: %d\n",
+                res);
+    return res;
+  }
+  for (zm = monitor_head; NULL != zm; zm = zm->next)
+  {
+    if ( (0 == memcmp (zone, &zm->zone,
+                       sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) ||
+         (0 == memcmp (&zm->zone,
+                       &zero,
+                       sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Notifying monitor about changes under label `%s'\n",
+                  conv_name);
+      send_lookup_response (monitor_nc,
+                            zm->nc->client,
+                            0,
+                            zone,
+                            conv_name,
+                            rd_count, rd);
+    }
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Monitor is for another zone\n");
+  }
+  if (NULL == monitor_head)
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "No monitors active\n");
+  refresh_block (client, rid, batch,
+                 zone,
+                 conv_name,
+                 rd_count, rd);
+  return GNUNET_OK;
+}
+
+
 /**
  * Handles a #GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE message
  *
@@ -929,7 +1569,6 @@ handle_record_store (void *cls,
   unsigned int rd_count;
   int res;
   struct GNUNET_CRYPTO_EcdsaPublicKey pubkey;
-  struct ZoneMonitor *zm;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received `%s' message\n",
@@ -996,86 +1635,168 @@ handle_record_store (void *cls,
 		(unsigned int) rd_count,
 		conv_name,
 		GNUNET_GNSRECORD_z2s (&pubkey));
+    res = store_record_set (client, rid, NULL,
+                            &rp_msg->private_key,
+                            conv_name,
+                            rd_count, rd);
+    GNUNET_free (conv_name);
+  }
+  if (GNUNET_OK != res)
+    send_store_response (client, res, rid);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
+/**
+ * Handles a #GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE_BATCH message.
+ * All record sets are stored within one database transaction (if the
+ * plugin supports them); the client gets a single response once all
+ * blocks were cached.
+ *
+ * @param cls unused
+ * @param client client sending the message
+ * @param message message of type `struct RecordStoreBatchMessage`
+ */
+static void
+handle_record_store_batch (void *cls,
+                           struct GNUNET_SERVER_Client *client,
+                           const struct GNUNET_MessageHeader *message)
+{
+  const struct RecordStoreBatchMessage *rb_msg;
+  const struct RecordStoreBatchEntry *entry;
+  struct StoreBatch *batch;
+  const char *pos;
+  const char *end;
+  const char *name_tmp;
+  char *conv_name;
+  size_t name_len;
+  size_t rd_ser_len;
+  unsigned int rd_count;
+  unsigned int count;
+  unsigned int i;
+  int res;
+  int in_transaction;
 
-    if ( (0 == rd_count) &&
-         (GNUNET_NO ==
-          GSN_database->iterate_records (GSN_database->cls,
-                                         &rp_msg->private_key, 0, NULL, 0)) )
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Received `%s' message\n",
+	      "NAMESTORE_RECORD_STORE_BATCH");
+  if (ntohs (message->size) < sizeof (struct RecordStoreBatchMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  rb_msg = (const struct RecordStoreBatchMessage *) message;
+  count = ntohl (rb_msg->count);
+  end = ((const char *) message) + ntohs (message->size);
+  /* validate all entries before touching the database */
+  pos = (const char *) &rb_msg[1];
+  for (i=0;i<count;i++)
+  {
+    entry = (const struct RecordStoreBatchEntry *) pos;
+    if ( (end - pos < sizeof (struct RecordStoreBatchEntry)) ||
+         (end - (const char *) &entry[1] <
+          ntohs (entry->name_len) + ntohs (entry->rd_len)) )
     {
-      /* This name does not exist, so cannot be removed */
-      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                  "Name `%s' does not exist, no deletion required\n",
-                  conv_name);
-      res = GNUNET_NO;
+      GNUNET_break (0);
+      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+      return;
+    }
+    name_len = ntohs (entry->name_len);
+    rd_ser_len = ntohs (entry->rd_len);
+    rd_count = ntohs (entry->rd_count);
+    name_tmp = (const char *) &entry[1];
+    if ( (0 == name_len) ||
+         (name_len > MAX_NAME_LEN) ||
+         ('\0' != name_tmp[name_len - 1]) )
+    {
+      GNUNET_break (0);
+      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+      return;
     }
-    else
     {
-      struct GNUNET_GNSRECORD_Data rd_clean[rd_count];
-      unsigned int i;
-      unsigned int rd_clean_off;
+      struct GNUNET_GNSRECORD_Data rd[rd_count];
 
-      /* remove "NICK" records, unless this is for the "+" label */
-      rd_clean_off = 0;
-      for (i=0;i<rd_count;i++)
-      {
-        rd_clean[rd_clean_off] = rd[i];
-        if ( (0 == strcmp (GNUNET_GNS_MASTERZONE_STR,
-                           conv_name)) ||
-             (GNUNET_GNSRECORD_TYPE_NICK != rd[i].record_type) )
-          rd_clean_off++;
-      }
-      res = GSN_database->store_records (GSN_database->cls,
-					 &rp_msg->private_key,
-					 conv_name,
-					 rd_clean_off, rd_clean);
-      if (GNUNET_OK == res)
-      {
-        for (zm = monitor_head; NULL != zm; zm = zm->next)
-        {
-          if ( (0 == memcmp (&rp_msg->private_key, &zm->zone,
-                             sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) ||
-               (0 == memcmp (&zm->zone,
-                             &zero,
-                             sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) )
-          {
-            GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                        "Notifying monitor about changes under label `%s'\n",
-                        conv_name);
-            send_lookup_response (monitor_nc,
-                                  zm->nc->client,
-                                  0,
-                                  &rp_msg->private_key,
-                                  conv_name,
-                                  rd_count, rd);
-          }
-          else
-            GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                        "Monitor is for another zone\n");
-        }
-        if (NULL == monitor_head)
-          GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                      "No monitors active\n");
-      }
-      else
+      if (GNUNET_OK !=
+          GNUNET_GNSRECORD_records_deserialize (rd_ser_len,
+                                                &name_tmp[name_len],
+                                                rd_count,
+                                                rd))
       {
-        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                    "Error storing record: %d\n",
-                    res);
+        GNUNET_break (0);
+        GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+        return;
       }
     }
-    if (GNUNET_OK == res)
+    pos = &name_tmp[name_len + rd_ser_len];
+  }
+  if (pos != end)
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  (void) client_lookup (client);
+  batch = GNUNET_new (struct StoreBatch);
+  batch->client = client;
+  batch->rid = ntohl (rb_msg->gns_header.r_id);
+  batch->result = GNUNET_OK;
+  /* hold a reference while submitting, so that the response is not
+     sent before all entries were processed */
+  batch->pending = 1;
+  in_transaction = GNUNET_NO;
+  if ( (NULL != GSN_database->begin_transaction) &&
+       (NULL != GSN_database->commit_transaction) )
+  {
+    if (GNUNET_OK == GSN_database->begin_transaction (GSN_database->cls))
+      in_transaction = GNUNET_YES;
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Failed to start database transaction, storing records one by one\n"));
+  }
+  pos = (const char *) &rb_msg[1];
+  for (i=0;i<count;i++)
+  {
+    entry = (const struct RecordStoreBatchEntry *) pos;
+    name_len = ntohs (entry->name_len);
+    rd_ser_len = ntohs (entry->rd_len);
+    rd_count = ntohs (entry->rd_count);
+    name_tmp = (const char *) &entry[1];
+    pos = &name_tmp[name_len + rd_ser_len];
+    conv_name = GNUNET_GNSRECORD_string_to_lowercase (name_tmp);
+    if (NULL == conv_name)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Error converting name `%s'\n", name_tmp);
+      batch->result = GNUNET_SYSERR;
+      continue;
+    }
     {
-      refresh_block (client, rid,
-                     &rp_msg->private_key,
-                     conv_name,
-                     rd_count, rd);
-      GNUNET_SERVER_receive_done (client, GNUNET_OK);
-      GNUNET_free (conv_name);
-      return;
+      struct GNUNET_GNSRECORD_Data rd[rd_count];
+
+      GNUNET_assert (GNUNET_OK ==
+                     GNUNET_GNSRECORD_records_deserialize (rd_ser_len,
+                                                           &name_tmp[name_len],
+                                                           rd_count,
+                                                           rd));
+      res = store_record_set (client, 0, batch,
+                              &rb_msg->private_key,
+                              conv_name,
+                              rd_count, rd);
     }
+    if ( (GNUNET_OK != res) &&
+         (GNUNET_OK == batch->result) )
+      batch->result = res;
     GNUNET_free (conv_name);
   }
-  send_store_response (client, res, rid);
+  if ( (GNUNET_YES == in_transaction) &&
+       (GNUNET_OK != GSN_database->commit_transaction (GSN_database->cls)) )
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Failed to commit database transaction\n"));
+    batch->result = GNUNET_SYSERR;
+  }
+  release_batch (batch, GNUNET_OK);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -1317,7 +2038,7 @@ zone_iterate_proc (void *cls,
       break;
     }
   if (GNUNET_YES == do_refresh_block)
-    refresh_block (NULL, 0,
+    refresh_block (NULL, 0, NULL,
                    zone_key,
                    name,
                    rd_count,
@@ -1326,6 +2047,137 @@ zone_iterate_proc (void *cls,
 }
 
 
+/**
+ * Add a record set returned by the database to the batch of a zone
+ * iteration, and advance the iteration's cursor past it.
+ *
+ * @param cls the `struct ZoneIteration`
+ * @param zone_key the zone key
+ * @param name name
+ * @param rd_count number of records for this name
+ * @param rd record data
+ */
+static void
+buffer_iteration_record (void *cls,
+                         const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                         const char *name,
+                         unsigned int rd_count,
+                         const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct ZoneIteration *zi = cls;
+  struct IterationRecord *rec;
+  size_t rd_ser_len;
+  size_t name_len;
+
+  GNUNET_free_non_null (zi->last_label);
+  zi->last_label = GNUNET_strdup (name);
+  zi->last_zone = *zone_key;
+  zi->batch_size++;
+  rd_ser_len = GNUNET_GNSRECORD_records_get_size (rd_count, rd);
+  name_len = strlen (name) + 1;
+  rec = GNUNET_malloc (sizeof (struct IterationRecord) + rd_ser_len + name_len);
+  rec->zone = *zone_key;
+  rec->rd_count = rd_count;
+  rec->rd_ser_len = rd_ser_len;
+  if (rd_ser_len !=
+      GNUNET_GNSRECORD_records_serialize (rd_count, rd,
+                                          rd_ser_len,
+                                          (char *) &rec[1]))
+  {
+    GNUNET_break (0);
+    GNUNET_free (rec);
+    return;
+  }
+  memcpy (((char *) &rec[1]) + rd_ser_len, name, name_len);
+  GNUNET_CONTAINER_DLL_insert_tail (zi->batch_head,
+                                    zi->batch_tail,
+                                    rec);
+}
+
+
+/**
+ * Fetch the next batch of records of a zone iteration from the
+ * database, continuing after the last record fetched.  A single
+ * query replaces #ITERATION_BATCH_SIZE queries with ever growing
+ * offsets.
+ *
+ * @param zi zone iteration to fetch records for
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on database errors
+ */
+static int
+fill_iteration_batch (struct ZoneIteration *zi)
+{
+  int ret;
+
+  zi->batch_size = 0;
+  ret = GSN_database->iterate_records_after (GSN_database->cls,
+                                             (0 == memcmp (&zi->zone, &zero, sizeof (zero)))
+                                             ? NULL
+                                             : &zi->zone,
+                                             (NULL == zi->last_label)
+                                             ? NULL
+                                             : &zi->last_zone,
+                                             zi->last_label,
+                                             ITERATION_BATCH_SIZE,
+                                             &buffer_iteration_record,
+                                             zi);
+  if (GNUNET_SYSERR == ret)
+    return GNUNET_SYSERR;
+  if (zi->batch_size < ITERATION_BATCH_SIZE)
+    zi->batch_exhausted = GNUNET_YES;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Give the next buffered record of a zone iteration to
+ * #zone_iterate_proc, fetching a new batch from the database if
+ * needed.
+ *
+ * @param proc iteration state
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on database errors
+ */
+static int
+next_batched_record (struct ZoneIterationProcResult *proc)
+{
+  struct ZoneIteration *zi = proc->zi;
+  struct IterationRecord *rec;
+  const char *name;
+
+  if ( (NULL == zi->batch_head) &&
+       (GNUNET_NO == zi->batch_exhausted) &&
+       (GNUNET_OK != fill_iteration_batch (zi)) )
+    return GNUNET_SYSERR;
+  if (NULL == (rec = zi->batch_head))
+  {
+    proc->res_iteration_finished = IT_SUCCESS_NOT_MORE_RESULTS_AVAILABLE;
+    return GNUNET_OK;
+  }
+  GNUNET_CONTAINER_DLL_remove (zi->batch_head,
+                               zi->batch_tail,
+                               rec);
+  name = ((const char *) &rec[1]) + rec->rd_ser_len;
+  {
+    struct GNUNET_GNSRECORD_Data rd[rec->rd_count];
+
+    if (GNUNET_OK !=
+        GNUNET_GNSRECORD_records_deserialize (rec->rd_ser_len,
+                                              (const char *) &rec[1],
+                                              rec->rd_count,
+                                              rd))
+      GNUNET_break (0);
+    else
+      zone_iterate_proc (proc,
+                         &rec->zone,
+                         name,
+                         rec->rd_count,
+                         rd);
+  }
+  GNUNET_free (rec);
+  return GNUNET_OK;
+}
+
+
 /**
  * Perform the next round of the zone iteration.
  *
@@ -1343,6 +2195,15 @@ run_zone_iteration_round (struct ZoneIteration *zi)
   proc.res_iteration_finished = IT_START;
   while (IT_START == proc.res_iteration_finished)
   {
+    if (NULL != GSN_database->iterate_records_after)
+    {
+      if (GNUNET_OK != next_batched_record (&proc))
+      {
+        GNUNET_break (0);
+        break;
+      }
+      continue;
+    }
     if (GNUNET_SYSERR ==
 	(ret = GSN_database->iterate_records (GSN_database->cls,
 					      (0 == memcmp (&zi->zone, &zero, sizeof (zero)))
@@ -1376,7 +2237,7 @@ run_zone_iteration_round (struct ZoneIteration *zi)
   GNUNET_CONTAINER_DLL_remove (zi->client->op_head,
 			       zi->client->op_tail,
 			       zi);
-  GNUNET_free (zi);
+  free_zone_iteration (zi);
 }
 
 
@@ -1455,7 +2316,7 @@ handle_iteration_stop (void *cls,
     return;
   }
   GNUNET_CONTAINER_DLL_remove (nc->op_head, nc->op_tail, zi);
-  GNUNET_free (zi);
+  free_zone_iteration (zi);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -1556,6 +2417,9 @@ monitor_iterate_cb (void *cls,
     monitor_sync (zm);
     return;
   }
+  GNUNET_free_non_null (zm->last_label);
+  zm->last_label = GNUNET_strdup (name);
+  zm->last_zone = *zone_key;
   send_lookup_response (monitor_nc,
 			zm->nc->client,
 			0,
@@ -1616,12 +2480,24 @@ monitor_next (void *cls,
   int ret;
 
   zm->task = NULL;
-  ret = GSN_database->iterate_records (GSN_database->cls,
-                                       (0 == memcmp (&zm->zone, &zero, sizeof (zero)))
-                                       ? NULL
-                                       : &zm->zone,
-				       zm->offset++,
-				       &monitor_iterate_cb, zm);
+  if (NULL != GSN_database->iterate_records_after)
+    ret = GSN_database->iterate_records_after (GSN_database->cls,
+                                               (0 == memcmp (&zm->zone, &zero, sizeof (zero)))
+                                               ? NULL
+                                               : &zm->zone,
+                                               (NULL == zm->last_label)
+                                               ? NULL
+                                               : &zm->last_zone,
+                                               zm->last_label,
+                                               1,
+                                               &monitor_iterate_cb, zm);
+  else
+    ret = GSN_database->iterate_records (GSN_database->cls,
+                                         (0 == memcmp (&zm->zone, &zero, sizeof (zero)))
+                                         ? NULL
+                                         : &zm->zone,
+                                         zm->offset++,
+                                         &monitor_iterate_cb, zm);
   if (GNUNET_SYSERR == ret)
   {
     GNUNET_SERVER_client_disconnect (zm->nc->client);
@@ -1650,6 +2526,8 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   static const struct GNUNET_SERVER_MessageHandler handlers[] = {
     {&handle_record_store, NULL,
      GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE, 0},
+    {&handle_record_store_batch, NULL,
+     GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE_BATCH, 0},
     {&handle_record_lookup, NULL,
      GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_LOOKUP, 0},
     {&handle_zone_to_name, NULL,
@@ -1669,6 +2547,11 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Starting namestore service\n");
   GSN_cfg = cfg;
   monitor_nc = GNUNET_SERVER_notification_context_create (server, 1);
+  label_keys = GNUNET_CONTAINER_multihashmap_create (MAX_LABEL_KEYS / 4,
+                                                     GNUNET_NO);
+  label_key_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  signing_map = GNUNET_CONTAINER_multihashmap_create (16,
+                                                      GNUNET_NO);
   namecache = GNUNET_NAMECACHE_connect (cfg);
   /* Loading database plugin */
   if (GNUNET_OK !=
@@ -99,6 +99,67 @@ struct RecordStoreMessage
 };
 
 
+/**
+ * Store a batch of record sets of one zone.
+ */
+struct RecordStoreBatchMessage
+{
+  /**
+   * Type will be #GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE_BATCH
+   */
+  struct GNUNET_NAMESTORE_Header gns_header;
+
+  /**
+   * Number of record sets in the batch.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /**
+   * always zero (for alignment)
+   */
+  uint32_t reserved GNUNET_PACKED;
+
+  /**
+   * The private key of the authority.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey private_key;
+
+  /* followed by @e count `struct RecordStoreBatchEntry` */
+};
+
+
+/**
+ * A record set in a #RecordStoreBatchMessage.
+ */
+struct RecordStoreBatchEntry
+{
+  /**
+   * Name length, including the 0-terminator
+   */
+  uint16_t name_len GNUNET_PACKED;
+
+  /**
+   * Length of serialized record data
+   */
+  uint16_t rd_len GNUNET_PACKED;
+
+  /**
+   * Number of records contained
+   */
+  uint16_t rd_count GNUNET_PACKED;
+
+  /**
+   * always zero (for alignment)
+   */
+  uint16_t reserved GNUNET_PACKED;
+
+  /* followed by:
+   * name with length name_len
+   * serialized record data with rd_count records
+   */
+};
+
+
 /**
  * Response to a record storage request.
  */
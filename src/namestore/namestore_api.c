@@ -1069,6 +1069,108 @@ GNUNET_NAMESTORE_records_store (struct GNUNET_NAMESTORE_Handle *h,
   return qe;
 }
 
+
+/**
+ * Store several record sets of a zone at once.  The namestore applies
+ * them in a single database transaction and signs the blocks for the
+ * namecache in parallel.
+ *
+ * @param h handle to the namestore
+ * @param pkey private key of the zone
+ * @param count number of entries in @a sets
+ * @param sets the record sets to store
+ * @param cont continuation to call when done
+ * @param cont_cls closure for @a cont
+ * @return handle to abort the request, NULL if the batch is too large
+ */
+struct GNUNET_NAMESTORE_QueueEntry *
+GNUNET_NAMESTORE_records_store_batch (struct GNUNET_NAMESTORE_Handle *h,
+                                      const struct GNUNET_CRYPTO_EcdsaPrivateKey *pkey,
+                                      unsigned int count,
+                                      const struct GNUNET_NAMESTORE_RecordSet *sets,
+                                      GNUNET_NAMESTORE_ContinuationWithStatus cont,
+                                      void *cont_cls)
+{
+  struct GNUNET_NAMESTORE_QueueEntry *qe;
+  struct PendingMessage *pe;
+  struct RecordStoreBatchMessage *msg;
+  struct RecordStoreBatchEntry *entry;
+  char *pos;
+  size_t msg_size;
+  size_t name_len;
+  size_t rd_ser_len;
+  uint32_t rid;
+  unsigned int i;
+
+  GNUNET_assert (NULL != h);
+  GNUNET_assert (NULL != pkey);
+  msg_size = sizeof (struct RecordStoreBatchMessage);
+  for (i=0;i<count;i++)
+  {
+    name_len = strlen (sets[i].label) + 1;
+    rd_ser_len = GNUNET_GNSRECORD_records_get_size (sets[i].rd_count,
+                                                    sets[i].rd);
+    if ( (name_len > MAX_NAME_LEN) ||
+         (rd_ser_len >= UINT16_MAX) ||
+         (sets[i].rd_count >= UINT16_MAX) )
+    {
+      GNUNET_break (0);
+      return NULL;
+    }
+    msg_size += sizeof (struct RecordStoreBatchEntry) + name_len + rd_ser_len;
+  }
+  if (msg_size >= GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  rid = get_op_id (h);
+  qe = GNUNET_new (struct GNUNET_NAMESTORE_QueueEntry);
+  qe->nsh = h;
+  qe->cont = cont;
+  qe->cont_cls = cont_cls;
+  qe->op_id = rid;
+  GNUNET_CONTAINER_DLL_insert_tail (h->op_head, h->op_tail, qe);
+
+  pe = GNUNET_malloc (sizeof (struct PendingMessage) + msg_size);
+  pe->size = msg_size;
+  msg = (struct RecordStoreBatchMessage *) &pe[1];
+  msg->gns_header.header.type = htons (GNUNET_MESSAGE_TYPE_NAMESTORE_RECORD_STORE_BATCH);
+  msg->gns_header.header.size = htons (msg_size);
+  msg->gns_header.r_id = htonl (rid);
+  msg->count = htonl (count);
+  msg->reserved = htonl (0);
+  msg->private_key = *pkey;
+  pos = (char *) &msg[1];
+  for (i=0;i<count;i++)
+  {
+    name_len = strlen (sets[i].label) + 1;
+    rd_ser_len = GNUNET_GNSRECORD_records_get_size (sets[i].rd_count,
+                                                    sets[i].rd);
+    entry = (struct RecordStoreBatchEntry *) pos;
+    entry->name_len = htons (name_len);
+    entry->rd_len = htons (rd_ser_len);
+    entry->rd_count = htons (sets[i].rd_count);
+    entry->reserved = htons (0);
+    pos = (char *) &entry[1];
+    memcpy (pos, sets[i].label, name_len);
+    pos += name_len;
+    GNUNET_break (rd_ser_len ==
+                  GNUNET_GNSRECORD_records_serialize (sets[i].rd_count,
+                                                      sets[i].rd,
+                                                      rd_ser_len,
+                                                      pos));
+    pos += rd_ser_len;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Sending `%s' message with %u record sets and size %u\n",
+       "NAMESTORE_RECORD_STORE_BATCH", count, (unsigned int) msg_size);
+  GNUNET_CONTAINER_DLL_insert_tail (h->pending_head, h->pending_tail, pe);
+  do_transmit (h);
+  return qe;
+}
+
+
 /**
  * Set the desired nick name for a zone
  *
@@ -94,6 +94,12 @@ create_indices (PGconn * dbh)
         GNUNET_POSTGRES_exec (dbh, "CREATE INDEX ir_label ON ns097records (label)")) )
     LOG (GNUNET_ERROR_TYPE_ERROR,
 	 _("Failed to create indices\n"));
+  /* separate, as databases created before this index was introduced
+     already have the others */
+  if (GNUNET_OK !=
+      GNUNET_POSTGRES_exec (dbh, "CREATE INDEX ir_zone_label ON ns097records (zone_private_key,label)"))
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+	 _("Failed to create indices\n"));
 }
 
 
@@ -183,6 +189,16 @@ database_setup (struct Plugin *plugin)
 				"iterate_all_zones",
 				"SELECT record_count,record_data,label,zone_private_key"
 				" FROM ns097records ORDER BY rvalue LIMIT 1 OFFSET $1", 1)) ||
+      (GNUNET_OK !=
+       GNUNET_POSTGRES_prepare (plugin->dbh,
+				"iterate_zone_after",
+				"SELECT record_count,record_data,label FROM ns097records"
+                                " WHERE zone_private_key=$1 AND label>$2 ORDER BY label LIMIT $3", 3)) ||
+      (GNUNET_OK !=
+       GNUNET_POSTGRES_prepare (plugin->dbh,
+				"next_zone",
+				"SELECT zone_private_key FROM ns097records"
+                                " WHERE zone_private_key>$1 ORDER BY zone_private_key LIMIT 1", 1)) ||
       (GNUNET_OK !=
        GNUNET_POSTGRES_prepare (plugin->dbh,
                                 "lookup_label",
@@ -284,77 +300,54 @@ namestore_postgres_store_records (void *cls,
 
 
 /**
- * A statement has been run.  We should evaluate the result, and if possible
- * call the given @a iter with the result.
+ * Parse a row of a result and call the given @a iter with it.
  *
- * @param plugin plugin context
- * @param res result from the statement that was run (to be cleaned up)
+ * @param res result of the statement that was run
+ * @param row row to parse
  * @param zone_key private key of the zone, could be NULL, in which case we should
  *        get the zone from @a res
  * @param iter iterator to call with the result
  * @param iter_cls closure for @a iter
- * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
  */
 static int
-get_record_and_call_iterator (struct Plugin *plugin,
-                              PGresult *res,
-			      const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
-			      GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+call_iterator_with_row (PGresult *res,
+                        int row,
+                        const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                        GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
 {
   const char *data;
   size_t data_size;
   uint32_t record_count;
   const char *label;
   size_t label_len;
-  unsigned int cnt;
 
-  if (GNUNET_OK !=
-      GNUNET_POSTGRES_check_result (plugin->dbh, res, PGRES_TUPLES_OK,
-                                    "PQexecPrepared",
-				    "iteration"))
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-	 "Failing lookup (postgres error)\n");
-    return GNUNET_SYSERR;
-  }
-  if (0 == (cnt = PQntuples (res)))
-  {
-    /* no result */
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-	 "Ending iteration (no more results)\n");
-    PQclear (res);
-    return GNUNET_NO;
-  }
-  GNUNET_assert (1 == cnt);
   GNUNET_assert (3 + ((NULL == zone_key) ? 1 : 0) == PQnfields (res));
   if (NULL == zone_key)
   {
-    if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) != PQgetlength (res, 0, 3))
+    if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) != PQgetlength (res, row, 3))
     {
       GNUNET_break (0);
-      PQclear (res);
       return GNUNET_SYSERR;
     }
-    zone_key = (const struct GNUNET_CRYPTO_EcdsaPrivateKey *) PQgetvalue (res, 0, 3);
+    zone_key = (const struct GNUNET_CRYPTO_EcdsaPrivateKey *) PQgetvalue (res, row, 3);
   }
   if (sizeof (uint32_t) != PQfsize (res, 0))
   {
     GNUNET_break (0);
-    PQclear (res);
     return GNUNET_SYSERR;
   }
 
-  record_count = ntohl (*(uint32_t *) PQgetvalue (res, 0, 0));
-  data = PQgetvalue (res, 0, 1);
-  data_size = PQgetlength (res, 0, 1);
-  label = PQgetvalue (res, 0, 2);
-  label_len = PQgetlength (res, 0, 1);
+  record_count = ntohl (*(uint32_t *) PQgetvalue (res, row, 0));
+  data = PQgetvalue (res, row, 1);
+  data_size = PQgetlength (res, row, 1);
+  label = PQgetvalue (res, row, 2);
+  label_len = PQgetlength (res, row, 2);
   if (record_count > 64 * 1024)
   {
     /* sanity check, don't stack allocate far too much just
        because database might contain a large value here */
     GNUNET_break (0);
-    PQclear (res);
     return GNUNET_SYSERR;
   }
   {
@@ -368,16 +361,98 @@ get_record_and_call_iterator (struct Plugin *plugin,
 					      record_count, rd))
     {
       GNUNET_break (0);
-      PQclear (res);
       return GNUNET_SYSERR;
     }
-    iter (iter_cls, zone_key, buf, record_count, rd);
+    if (NULL != iter)
+      iter (iter_cls, zone_key, buf, record_count, rd);
   }
-  PQclear (res);
   return GNUNET_OK;
 }
 
 
+/**
+ * A statement has been run.  We should evaluate the result, and if possible
+ * call the given @a iter with the result.
+ *
+ * @param plugin plugin context
+ * @param res result from the statement that was run (to be cleaned up)
+ * @param zone_key private key of the zone, could be NULL, in which case we should
+ *        get the zone from @a res
+ * @param iter iterator to call with the result
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK on success, #GNUNET_NO if there were no results, #GNUNET_SYSERR on error
+ */
+static int
+get_record_and_call_iterator (struct Plugin *plugin,
+                              PGresult *res,
+			      const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+			      GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  unsigned int cnt;
+  int ret;
+
+  if (GNUNET_OK !=
+      GNUNET_POSTGRES_check_result (plugin->dbh, res, PGRES_TUPLES_OK,
+                                    "PQexecPrepared",
+				    "iteration"))
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+	 "Failing lookup (postgres error)\n");
+    return GNUNET_SYSERR;
+  }
+  if (0 == (cnt = PQntuples (res)))
+  {
+    /* no result */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+	 "Ending iteration (no more results)\n");
+    PQclear (res);
+    return GNUNET_NO;
+  }
+  GNUNET_assert (1 == cnt);
+  ret = call_iterator_with_row (res, 0, zone_key, iter, iter_cls);
+  PQclear (res);
+  return ret;
+}
+
+
+/**
+ * A statement returning any number of records has been run.  Call
+ * the given @a iter with each of them.
+ *
+ * @param plugin plugin context
+ * @param res result from the statement that was run (to be cleaned up)
+ * @param zone_key private key of the zone
+ * @param iter iterator to call with the results
+ * @param iter_cls closure for @a iter
+ * @return number of records given to @a iter, -1 on error
+ */
+static int64_t
+get_records_and_call_iterator (struct Plugin *plugin,
+                               PGresult *res,
+                               const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                               GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  int cnt;
+  int i;
+
+  if (GNUNET_OK !=
+      GNUNET_POSTGRES_check_result (plugin->dbh, res, PGRES_TUPLES_OK,
+                                    "PQexecPrepared",
+				    "iteration"))
+    return -1;
+  cnt = PQntuples (res);
+  for (i = 0; i < cnt; i++)
+    if (GNUNET_OK !=
+        call_iterator_with_row (res, i, zone_key, iter, iter_cls))
+    {
+      PQclear (res);
+      return -1;
+    }
+  PQclear (res);
+  return cnt;
+}
+
+
 /**
  * Lookup records in the datastore for which we are the authority.
  *
@@ -483,6 +558,206 @@ namestore_postgres_iterate_records (void *cls,
 }
 
 
+/**
+ * Start a transaction.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+namestore_postgres_begin_transaction (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  return GNUNET_POSTGRES_exec (plugin->dbh, "BEGIN");
+}
+
+
+/**
+ * Commit the current transaction.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+namestore_postgres_commit_transaction (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  return GNUNET_POSTGRES_exec (plugin->dbh, "COMMIT");
+}
+
+
+/**
+ * Return up to @a limit records of @a zone with labels after
+ * @a after_label, in the order of their labels.
+ *
+ * @param plugin plugin context
+ * @param zone private key of the zone
+ * @param after_label return only labels after this one
+ * @param limit maximum number of records to return
+ * @param iter function to call with each result
+ * @param iter_cls closure for @a iter
+ * @return number of records returned, -1 on error
+ */
+static int64_t
+iterate_zone_after (struct Plugin *plugin,
+                    const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                    const char *after_label,
+                    uint64_t limit,
+                    GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  uint64_t limit_be = GNUNET_htonll (limit);
+  const char *paramValues[] = {
+    (const char *) zone,
+    after_label,
+    (const char *) &limit_be
+  };
+  int paramLengths[] = {
+    sizeof (*zone),
+    strlen (after_label),
+    sizeof (limit_be)
+  };
+  const int paramFormats[] = { 1, 1, 1 };
+  PGresult *res;
+
+  res = PQexecPrepared (plugin->dbh,
+                        "iterate_zone_after", 3,
+                        paramValues, paramLengths, paramFormats,
+                        1);
+  return get_records_and_call_iterator (plugin,
+                                        res,
+                                        zone,
+                                        iter, iter_cls);
+}
+
+
+/**
+ * Find the first zone after @a zone that has records.
+ *
+ * @param plugin plugin context
+ * @param zone the current zone, NULL to find the first zone
+ * @param next set to the next zone
+ * @return #GNUNET_OK on success, #GNUNET_NO if there is no further zone,
+ *         #GNUNET_SYSERR on error
+ */
+static int
+find_next_zone (struct Plugin *plugin,
+                const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                struct GNUNET_CRYPTO_EcdsaPrivateKey *next)
+{
+  /* an empty BYTEA sorts before all zone keys */
+  const char *paramValues[] = {
+    (NULL == zone) ? "" : (const char *) zone
+  };
+  int paramLengths[] = {
+    (NULL == zone) ? 0 : sizeof (*zone)
+  };
+  const int paramFormats[] = { 1 };
+  PGresult *res;
+  int ret;
+
+  res = PQexecPrepared (plugin->dbh,
+                        "next_zone", 1,
+                        paramValues, paramLengths, paramFormats,
+                        1);
+  if (GNUNET_OK !=
+      GNUNET_POSTGRES_check_result (plugin->dbh, res, PGRES_TUPLES_OK,
+                                    "PQexecPrepared",
+				    "next_zone"))
+    return GNUNET_SYSERR;
+  if (0 == PQntuples (res))
+    ret = GNUNET_NO;
+  else if (sizeof (*next) != PQgetlength (res, 0, 0))
+  {
+    GNUNET_break (0);
+    ret = GNUNET_SYSERR;
+  }
+  else
+  {
+    memcpy (next, PQgetvalue (res, 0, 0), sizeof (*next));
+    ret = GNUNET_OK;
+  }
+  PQclear (res);
+  return ret;
+}
+
+
+/**
+ * Iterate over the records of a zone (or of all zones) ordered by
+ * zone and label, starting right after the given position.  Each zone
+ * is walked with an index scan on (zone_private_key, label); when a
+ * zone is exhausted before @a limit records were found, we move on to
+ * the next zone.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param zone private key of the zone, NULL for all zones
+ * @param after_zone zone of the last record returned by the previous
+ *        call; ignored if @a zone is not NULL
+ * @param after_label label of the last record returned by the previous
+ *        call, NULL to start from the beginning
+ * @param limit maximum number of results to return to @a iter
+ * @param iter function to call with each result
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK if there were results, #GNUNET_NO if there were no (more) results, #GNUNET_SYSERR on error
+ */
+static int
+namestore_postgres_iterate_records_after (void *cls,
+                                          const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                                          const struct GNUNET_CRYPTO_EcdsaPrivateKey *after_zone,
+                                          const char *after_label,
+                                          uint64_t limit,
+                                          GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey cur;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey next;
+  const char *label;
+  uint64_t total;
+  int64_t cnt;
+  int ret;
+
+  label = (NULL == after_label) ? "" : after_label;
+  if (NULL != zone)
+  {
+    cnt = iterate_zone_after (plugin, zone, label, limit, iter, iter_cls);
+    if (cnt < 0)
+      return GNUNET_SYSERR;
+    return (0 == cnt) ? GNUNET_NO : GNUNET_OK;
+  }
+  total = 0;
+  if ( (NULL == after_label) ||
+       (NULL == after_zone) )
+  {
+    ret = find_next_zone (plugin, NULL, &cur);
+    label = "";
+  }
+  else
+  {
+    cur = *after_zone;
+    ret = GNUNET_OK;
+  }
+  while ( (GNUNET_OK == ret) &&
+          (total < limit) )
+  {
+    cnt = iterate_zone_after (plugin, &cur, label, limit - total,
+                              iter, iter_cls);
+    if (cnt < 0)
+      return GNUNET_SYSERR;
+    total += cnt;
+    if (total < limit)
+    {
+      ret = find_next_zone (plugin, &cur, &next);
+      cur = next;
+      label = "";
+    }
+  }
+  if (GNUNET_SYSERR == ret)
+    return GNUNET_SYSERR;
+  return (0 == total) ? GNUNET_NO : GNUNET_OK;
+}
+
+
 /**
  * Look for an existing PKEY delegation record for a given public key.
  * Returns at most one result to the iterator.
@@ -563,6 +838,9 @@ libgnunet_plugin_namestore_postgres_init (void *cls)
   api->cls = &plugin;
   api->store_records = &namestore_postgres_store_records;
   api->iterate_records = &namestore_postgres_iterate_records;
+  api->iterate_records_after = &namestore_postgres_iterate_records_after;
+  api->begin_transaction = &namestore_postgres_begin_transaction;
+  api->commit_transaction = &namestore_postgres_commit_transaction;
   api->zone_to_name = &namestore_postgres_zone_to_name;
   api->lookup_records = &namestore_postgres_lookup_records;
   LOG (GNUNET_ERROR_TYPE_INFO,
@@ -92,6 +92,16 @@ struct Plugin
    */
   sqlite3_stmt *iterate_all_zones;
 
+  /**
+   * Precompiled SQL to iterate records within a zone after a label.
+   */
+  sqlite3_stmt *iterate_zone_after;
+
+  /**
+   * Precompiled SQL to find the zone following a given zone.
+   */
+  sqlite3_stmt *next_zone;
+
   /**
    * Precompiled SQL to for reverse lookup based on PKEY.
    */
@@ -144,6 +154,9 @@ create_indices (sqlite3 * dbh)
 		      NULL, NULL, NULL)) ||
        (SQLITE_OK !=
 	sqlite3_exec (dbh, "CREATE INDEX IF NOT EXISTS it_iter ON ns097records (rvalue)",
+		      NULL, NULL, NULL)) ||
+       (SQLITE_OK !=
+	sqlite3_exec (dbh, "CREATE INDEX IF NOT EXISTS ir_label ON ns097records (zone_private_key,label)",
 		      NULL, NULL, NULL)) )
     LOG (GNUNET_ERROR_TYPE_ERROR,
 	 "Failed to create indices: %s\n", sqlite3_errmsg (dbh));
@@ -280,6 +293,16 @@ database_setup (struct Plugin *plugin)
 	"SELECT record_count,record_data,label,zone_private_key"
 	" FROM ns097records ORDER BY rvalue LIMIT 1 OFFSET ?",
 	&plugin->iterate_all_zones) != SQLITE_OK)  ||
+      (sq_prepare
+       (plugin->dbh,
+	"SELECT record_count,record_data,label"
+	" FROM ns097records WHERE zone_private_key=? AND label>? ORDER BY label LIMIT ?",
+	&plugin->iterate_zone_after) != SQLITE_OK) ||
+      (sq_prepare
+       (plugin->dbh,
+	"SELECT zone_private_key"
+	" FROM ns097records WHERE zone_private_key>? ORDER BY zone_private_key LIMIT 1",
+	&plugin->next_zone) != SQLITE_OK) ||
       (sq_prepare
        (plugin->dbh,
         "SELECT record_count,record_data,label,zone_private_key"
@@ -313,6 +336,10 @@ database_shutdown (struct Plugin *plugin)
     sqlite3_finalize (plugin->iterate_zone);
   if (NULL != plugin->iterate_all_zones)
     sqlite3_finalize (plugin->iterate_all_zones);
+  if (NULL != plugin->iterate_zone_after)
+    sqlite3_finalize (plugin->iterate_zone_after);
+  if (NULL != plugin->next_zone)
+    sqlite3_finalize (plugin->next_zone);
   if (NULL != plugin->zone_to_name)
     sqlite3_finalize (plugin->zone_to_name);
   if (NULL != plugin->zone_to_name)
@@ -460,6 +487,73 @@ namestore_sqlite_store_records (void *cls,
 }
 
 
+/**
+ * The given 'sqlite' statement has returned a row with a record.
+ * Parses the record and gives it to the iterator.
+ *
+ * @param stmt statement positioned on the row
+ * @param zone_key private key of the zone, NULL to take it from the
+ *        fourth column of the row
+ * @param iter iterator to call with the result
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_YES on success, #GNUNET_SYSERR on error
+ */
+static int
+call_iterator_with_row (sqlite3_stmt *stmt,
+                        const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
+                        GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  unsigned int record_count;
+  size_t data_size;
+  const char *data;
+  const char *label;
+  int ret;
+
+  ret = GNUNET_SYSERR;
+  record_count = sqlite3_column_int (stmt, 0);
+  data_size = sqlite3_column_bytes (stmt, 1);
+  data = sqlite3_column_blob (stmt, 1);
+  label = (const char*) sqlite3_column_text (stmt, 2);
+  if (NULL == zone_key)
+  {
+    /* must be "iterate_all_zones", got one extra return value */
+    if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) !=
+        sqlite3_column_bytes (stmt, 3))
+    {
+      GNUNET_break (0);
+      return GNUNET_SYSERR;
+    }
+    zone_key = sqlite3_column_blob (stmt, 3);
+  }
+  if (record_count > 64 * 1024)
+  {
+    /* sanity check, don't stack allocate far too much just
+       because database might contain a large value here */
+    GNUNET_break (0);
+    ret = GNUNET_SYSERR;
+  }
+  else
+  {
+    struct GNUNET_GNSRECORD_Data rd[record_count];
+
+    if (GNUNET_OK !=
+        GNUNET_GNSRECORD_records_deserialize (data_size, data,
+                                              record_count, rd))
+    {
+      GNUNET_break (0);
+      ret = GNUNET_SYSERR;
+    }
+    else
+    {
+      if (NULL != iter)
+        iter (iter_cls, zone_key, label, record_count, rd);
+      ret = GNUNET_YES;
+    }
+  }
+  return ret;
+}
+
+
 /**
  * The given 'sqlite' statement has been prepared to be run.
  * It will return a record which should be given to the iterator.
@@ -478,59 +572,13 @@ get_record_and_call_iterator (struct Plugin *plugin,
 			      const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone_key,
 			      GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
 {
-  unsigned int record_count;
-  size_t data_size;
-  const char *data;
-  const char *label;
   int ret;
   int sret;
 
   ret = GNUNET_NO;
   if (SQLITE_ROW == (sret = sqlite3_step (stmt)))
   {
-    record_count = sqlite3_column_int (stmt, 0);
-    data_size = sqlite3_column_bytes (stmt, 1);
-    data = sqlite3_column_blob (stmt, 1);
-    label = (const char*) sqlite3_column_text (stmt, 2);
-    if (NULL == zone_key)
-    {
-      /* must be "iterate_all_zones", got one extra return value */
-      if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) !=
-	  sqlite3_column_bytes (stmt, 3))
-      {
-	GNUNET_break (0);
-	ret = GNUNET_SYSERR;
-      }
-      else
-      {
-	zone_key = sqlite3_column_blob (stmt, 3);
-      }
-    }
-    if (record_count > 64 * 1024)
-    {
-      /* sanity check, don't stack allocate far too much just
-	 because database might contain a large value here */
-      GNUNET_break (0);
-      ret = GNUNET_SYSERR;
-    }
-    else
-    {
-      struct GNUNET_GNSRECORD_Data rd[record_count];
-
-      if (GNUNET_OK !=
-	  GNUNET_GNSRECORD_records_deserialize (data_size, data,
-						record_count, rd))
-      {
-	GNUNET_break (0);
-	ret = GNUNET_SYSERR;
-      }
-      else if (NULL != zone_key)
-      {
-      	if (NULL != iter)
-      		iter (iter_cls, zone_key, label, record_count, rd);
-	ret = GNUNET_YES;
-      }
-    }
+    ret = call_iterator_with_row (stmt, zone_key, iter, iter_cls);
   }
   else
   {
@@ -640,6 +688,249 @@ namestore_sqlite_iterate_records (void *cls,
 }
 
 
+/**
+ * Start a transaction.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+namestore_sqlite_begin_transaction (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh, "BEGIN TRANSACTION", NULL, NULL, NULL))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR, "sqlite3_exec");
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Commit the current transaction.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+namestore_sqlite_commit_transaction (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  if (SQLITE_OK !=
+      sqlite3_exec (plugin->dbh, "COMMIT TRANSACTION", NULL, NULL, NULL))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR, "sqlite3_exec");
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Return up to @a limit records of @a zone with labels after
+ * @a after_label, in the order of their labels.
+ *
+ * @param plugin plugin context
+ * @param zone private key of the zone
+ * @param after_label return only labels after this one
+ * @param limit maximum number of records to return
+ * @param iter function to call with each result
+ * @param iter_cls closure for @a iter
+ * @return number of records returned, -1 on error
+ */
+static int64_t
+iterate_zone_after (struct Plugin *plugin,
+                    const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                    const char *after_label,
+                    uint64_t limit,
+                    GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  sqlite3_stmt *stmt = plugin->iterate_zone_after;
+  int64_t cnt;
+  int sret;
+
+  if ( (SQLITE_OK != sqlite3_bind_blob (stmt, 1,
+                                        zone, sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
+                                        SQLITE_STATIC)) ||
+       (SQLITE_OK != sqlite3_bind_text (stmt, 2,
+                                        after_label, -1, SQLITE_STATIC)) ||
+       (SQLITE_OK != sqlite3_bind_int64 (stmt, 3,
+                                         (sqlite3_int64) limit)) )
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		"sqlite3_bind_XXXX");
+    if (SQLITE_OK != sqlite3_reset (stmt))
+      LOG_SQLITE (plugin,
+		  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		  "sqlite3_reset");
+    return -1;
+  }
+  cnt = 0;
+  while (SQLITE_ROW == (sret = sqlite3_step (stmt)))
+  {
+    if (GNUNET_YES != call_iterator_with_row (stmt, zone, iter, iter_cls))
+    {
+      cnt = -1;
+      break;
+    }
+    cnt++;
+  }
+  if ( (0 <= cnt) &&
+       (SQLITE_DONE != sret) )
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR, "sqlite_step");
+    cnt = -1;
+  }
+  if (SQLITE_OK != sqlite3_reset (stmt))
+    LOG_SQLITE (plugin,
+		GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		"sqlite3_reset");
+  return cnt;
+}
+
+
+/**
+ * Find the first zone after @a zone that has records.
+ *
+ * @param plugin plugin context
+ * @param zone the current zone, NULL to find the first zone
+ * @param next set to the next zone
+ * @return #GNUNET_OK on success, #GNUNET_NO if there is no further zone,
+ *         #GNUNET_SYSERR on error
+ */
+static int
+find_next_zone (struct Plugin *plugin,
+                const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                struct GNUNET_CRYPTO_EcdsaPrivateKey *next)
+{
+  static const char empty;
+  sqlite3_stmt *stmt = plugin->next_zone;
+  int ret;
+  int sret;
+
+  /* a zero-length blob sorts before all zone keys */
+  if (SQLITE_OK != sqlite3_bind_blob (stmt, 1,
+                                      (NULL == zone) ? (const void *) &empty : zone,
+                                      (NULL == zone) ? 0 : sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey),
+                                      SQLITE_STATIC))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		"sqlite3_bind_XXXX");
+    if (SQLITE_OK != sqlite3_reset (stmt))
+      LOG_SQLITE (plugin,
+		  GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		  "sqlite3_reset");
+    return GNUNET_SYSERR;
+  }
+  ret = GNUNET_NO;
+  if (SQLITE_ROW == (sret = sqlite3_step (stmt)))
+  {
+    if (sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey) !=
+        sqlite3_column_bytes (stmt, 0))
+    {
+      GNUNET_break (0);
+      ret = GNUNET_SYSERR;
+    }
+    else
+    {
+      memcpy (next,
+              sqlite3_column_blob (stmt, 0),
+              sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey));
+      ret = GNUNET_OK;
+    }
+  }
+  else if (SQLITE_DONE != sret)
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR, "sqlite_step");
+    ret = GNUNET_SYSERR;
+  }
+  if (SQLITE_OK != sqlite3_reset (stmt))
+    LOG_SQLITE (plugin,
+		GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+		"sqlite3_reset");
+  return ret;
+}
+
+
+/**
+ * Iterate over the records of a zone (or of all zones) ordered by
+ * zone and label, starting right after the given position.  Each zone
+ * is walked with an index seek on (zone_private_key, label); when a
+ * zone is exhausted before @a limit records were found, we seek to the
+ * next zone.
+ *
+ * @param cls closure (internal context for the plugin)
+ * @param zone private key of the zone, NULL for all zones
+ * @param after_zone zone of the last record returned by the previous
+ *        call; ignored if @a zone is not NULL
+ * @param after_label label of the last record returned by the previous
+ *        call, NULL to start from the beginning
+ * @param limit maximum number of results to return to @a iter
+ * @param iter function to call with each result
+ * @param iter_cls closure for @a iter
+ * @return #GNUNET_OK if there were results, #GNUNET_NO if there were no (more) results, #GNUNET_SYSERR on error
+ */
+static int
+namestore_sqlite_iterate_records_after (void *cls,
+                                        const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+                                        const struct GNUNET_CRYPTO_EcdsaPrivateKey *after_zone,
+                                        const char *after_label,
+                                        uint64_t limit,
+                                        GNUNET_NAMESTORE_RecordIterator iter, void *iter_cls)
+{
+  struct Plugin *plugin = cls;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey cur;
+  struct GNUNET_CRYPTO_EcdsaPrivateKey next;
+  const char *label;
+  uint64_t total;
+  int64_t cnt;
+  int ret;
+
+  label = (NULL == after_label) ? "" : after_label;
+  if (NULL != zone)
+  {
+    cnt = iterate_zone_after (plugin, zone, label, limit, iter, iter_cls);
+    if (cnt < 0)
+      return GNUNET_SYSERR;
+    return (0 == cnt) ? GNUNET_NO : GNUNET_OK;
+  }
+  total = 0;
+  if ( (NULL == after_label) ||
+       (NULL == after_zone) )
+  {
+    ret = find_next_zone (plugin, NULL, &cur);
+    label = "";
+  }
+  else
+  {
+    cur = *after_zone;
+    ret = GNUNET_OK;
+  }
+  while ( (GNUNET_OK == ret) &&
+          (total < limit) )
+  {
+    cnt = iterate_zone_after (plugin, &cur, label, limit - total,
+                              iter, iter_cls);
+    if (cnt < 0)
+      return GNUNET_SYSERR;
+    total += cnt;
+    if (total < limit)
+    {
+      ret = find_next_zone (plugin, &cur, &next);
+      cur = next;
+      label = "";
+    }
+  }
+  if (GNUNET_SYSERR == ret)
+    return GNUNET_SYSERR;
+  return (0 == total) ? GNUNET_NO : GNUNET_OK;
+}
+
+
 /**
  * Look for an existing PKEY delegation record for a given public key.
  * Returns at most one result to the iterator.
@@ -710,6 +1001,9 @@ libgnunet_plugin_namestore_sqlite_init (void *cls)
   api->cls = &plugin;
   api->store_records = &namestore_sqlite_store_records;
   api->iterate_records = &namestore_sqlite_iterate_records;
+  api->iterate_records_after = &namestore_sqlite_iterate_records_after;
+  api->begin_transaction = &namestore_sqlite_begin_transaction;
+  api->commit_transaction = &namestore_sqlite_commit_transaction;
   api->zone_to_name = &namestore_sqlite_zone_to_name;
   api->lookup_records = &namestore_sqlite_lookup_records;
   LOG (GNUNET_ERROR_TYPE_INFO,
@@ -52,16 +52,91 @@
 
 #define GNUNET_REST_JSONAPI_NAMESTORE_EGO "ego"
 
+/**
+ * How long do we wait for the services before we give up on a request?
+ * The plugin keeps its service connections open between requests, so
+ * there is no per-request check whether the services are running.
+ */
+#define REQUEST_TIMEOUT GNUNET_TIME_UNIT_MINUTES
+
+struct RequestHandle;
+
+/**
+ * An ego known to the identity service.
+ */
+struct EgoEntry
+{
+  /**
+   * DLL
+   */
+  struct EgoEntry *next;
+
+  /**
+   * DLL
+   */
+  struct EgoEntry *prev;
+
+  /**
+   * Name of the ego
+   */
+  char *name;
+
+  /**
+   * Private key of the ego
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey pkey;
+};
+
 /**
  * @brief struct returned by the initialization function of the plugin
  */
 struct Plugin
 {
   const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+  /**
+   * Handle to NAMESTORE, shared by all requests
+   */
+  struct GNUNET_NAMESTORE_Handle *ns_handle;
+
+  /**
+   * Handle to the identity service, shared by all requests
+   */
+  struct GNUNET_IDENTITY_Handle *identity_handle;
+
+  /**
+   * Egos known to the identity service
+   */
+  struct EgoEntry *ego_head;
+
+  /**
+   * Egos known to the identity service
+   */
+  struct EgoEntry *ego_tail;
+
+  /**
+   * Requests waiting for the initial list of egos
+   */
+  struct RequestHandle *waiting_head;
+
+  /**
+   * Requests waiting for the initial list of egos
+   */
+  struct RequestHandle *waiting_tail;
+
+  /**
+   * #GNUNET_YES once the identity service told us about all egos
+   */
+  int egos_complete;
 };
 
 const struct GNUNET_CONFIGURATION_Handle *cfg;
 
+/**
+ * The plugin
+ */
+static struct Plugin plugin;
+
 struct RecordEntry
 {
   /**
@@ -76,8 +151,59 @@ struct RecordEntry
   
 };
 
+/**
+ * A name whose records are replaced as part of a bulk update.
+ */
+struct BulkEntry
+{
+  /**
+   * DLL
+   */
+  struct BulkEntry *next;
+
+  /**
+   * DLL
+   */
+  struct BulkEntry *prev;
+
+  /**
+   * Request this entry belongs to
+   */
+  struct RequestHandle *handle;
+
+  /**
+   * Name of the records
+   */
+  char *name;
+
+  /**
+   * Records to store
+   */
+  struct GNUNET_GNSRECORD_Data *rd;
+
+  /**
+   * record count
+   */
+  unsigned int rd_count;
+
+  /**
+   * NAMESTORE Operation
+   */
+  struct GNUNET_NAMESTORE_QueueEntry *qe;
+};
+
 struct RequestHandle
 {
+  /**
+   * DLL of requests waiting for the egos
+   */
+  struct RequestHandle *next;
+
+  /**
+   * DLL of requests waiting for the egos
+   */
+  struct RequestHandle *prev;
+
   /**
    * Ego list
    */
@@ -99,12 +225,7 @@ struct RequestHandle
   struct RestConnectionDataHandle *conndata_handle;
   
   /**
-   * Handle to GNS service.
-   */
-  struct GNUNET_IDENTITY_Handle *identity_handle;
-
-  /**
-   * Handle to NAMESTORE
+   * Handle to NAMESTORE (owned by the plugin)
    */
   struct GNUNET_NAMESTORE_Handle *ns_handle;
   
@@ -118,11 +239,6 @@ struct RequestHandle
    */
   struct GNUNET_CRYPTO_EcdsaPrivateKey zone_pkey;
 
-  /**
-   * Handle to identity lookup
-   */
-  struct GNUNET_IDENTITY_EgoLookup *ego_lookup;
-
   /**
    * Default Ego operation
    */
@@ -168,13 +284,33 @@ struct RequestHandle
    */
   unsigned int rd_count;
 
+  /**
+   * Names to update in a bulk request
+   */
+  struct BulkEntry *bulk_head;
+
+  /**
+   * Names to update in a bulk request
+   */
+  struct BulkEntry *bulk_tail;
+
+  /**
+   * #GNUNET_YES if storing any of the bulk entries failed
+   */
+  int bulk_failed;
+
+  /**
+   * #GNUNET_YES if the request is waiting for the egos
+   */
+  int waiting;
+
     /**
    * NAMESTORE Operation
    */
   struct GNUNET_NAMESTORE_QueueEntry *add_qe;
 
   /**
-   * Desired timeout for the lookup (default is no timeout).
+   * Desired timeout for the request.
    */
   struct GNUNET_TIME_Relative timeout;
 
@@ -216,6 +352,27 @@ struct RequestHandle
 };
 
 
+/**
+ * Free records parsed from JSON.
+ *
+ * @param rd records to free
+ * @param rd_count number of entries in @a rd
+ */
+static void
+free_records (struct GNUNET_GNSRECORD_Data *rd,
+              unsigned int rd_count)
+{
+  unsigned int i;
+
+  for (i = 0; i < rd_count; i++)
+  {
+    if (NULL != rd[i].data)
+      GNUNET_free ((void*)rd[i].data);
+  }
+  GNUNET_free (rd);
+}
+
+
 /**
  * Cleanup lookup handle
  * @param handle Handle to clean up
@@ -225,38 +382,42 @@ cleanup_handle (struct RequestHandle *handle)
 {
   struct RecordEntry *record_entry;
   struct RecordEntry *record_tmp;
-  int i;
+  struct BulkEntry *bulk_entry;
+
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Cleaning up\n");
   if (NULL != handle->name)
     GNUNET_free (handle->name);
   if (NULL != handle->timeout_task)
     GNUNET_SCHEDULER_cancel (handle->timeout_task);
-  if (NULL != handle->ego_lookup)
-    GNUNET_IDENTITY_ego_lookup_cancel (handle->ego_lookup);
+  if (GNUNET_YES == handle->waiting)
+    GNUNET_CONTAINER_DLL_remove (plugin.waiting_head,
+                                 plugin.waiting_tail,
+                                 handle);
   if (NULL != handle->get_default)
     GNUNET_IDENTITY_cancel (handle->get_default);
   if (NULL != handle->list_it)
     GNUNET_NAMESTORE_zone_iteration_stop (handle->list_it);
   if (NULL != handle->add_qe)
     GNUNET_NAMESTORE_cancel (handle->add_qe);
-  if (NULL != handle->identity_handle)
-    GNUNET_IDENTITY_disconnect (handle->identity_handle);
-  if (NULL != handle->ns_handle)
-    GNUNET_NAMESTORE_disconnect (handle->ns_handle);
+  while (NULL != (bulk_entry = handle->bulk_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (handle->bulk_head,
+                                 handle->bulk_tail,
+                                 bulk_entry);
+    if (NULL != bulk_entry->qe)
+      GNUNET_NAMESTORE_cancel (bulk_entry->qe);
+    if (NULL != bulk_entry->rd)
+      free_records (bulk_entry->rd, bulk_entry->rd_count);
+    GNUNET_free_non_null (bulk_entry->name);
+    GNUNET_free (bulk_entry);
+  }
   if (NULL != handle->url)
     GNUNET_free (handle->url);
   if (NULL != handle->value)
     GNUNET_free (handle->value);
   if (NULL != handle->rd)
-  {
-    for (i = 0; i < handle->rd_count; i++)
-    {
-      if (NULL != handle->rd[i].data)
-        GNUNET_free ((void*)handle->rd[i].data);
-    }
-    GNUNET_free (handle->rd);
-  }
+    free_records (handle->rd, handle->rd_count);
   if (NULL != handle->ego_name)
     GNUNET_free (handle->ego_name);
   for (record_entry = handle->record_head;
@@ -671,39 +832,95 @@ json_to_gnsrecord (const json_t *records_json,
   return GNUNET_OK;
 }
 
-static void
-namestore_create_cont (struct RestConnectionDataHandle *con,
-                       const char *url,
-                       void *cls)
+/**
+ * Read the name and the records of a JSONAPI resource.
+ *
+ * @param json_res the resource
+ * @param name set to the name of the records
+ * @param rd set to the records, free with #free_records()
+ * @param rd_count set to the number of records
+ * @return #GNUNET_OK on success, #GNUNET_NO if the resource has
+ *         the wrong type, #GNUNET_SYSERR if it is malformed
+ */
+static int
+json_to_named_records (struct JsonApiResource *json_res,
+                       char **name,
+                       struct GNUNET_GNSRECORD_Data **rd,
+                       unsigned int *rd_count)
 {
-  struct RequestHandle *handle = cls;
-  struct MHD_Response *resp;
-  struct JsonApiObject *json_obj;
-  struct JsonApiResource *json_res;
   json_t *name_json;
   json_t *records_json;
+
+  if (GNUNET_NO == GNUNET_REST_jsonapi_resource_check_type (json_res,
+                                                            GNUNET_REST_JSONAPI_NAMESTORE_RECORD))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Unsupported JSON data type\n");
+    return GNUNET_NO;
+  }
+  name_json = GNUNET_REST_jsonapi_resource_read_attr (json_res, GNUNET_REST_JSONAPI_KEY_ID);
+  if (!json_is_string (name_json))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Name property is no string\n");
+    return GNUNET_SYSERR;
+  }
+  GNUNET_asprintf (name, "%s", json_string_value (name_json));
+  records_json = GNUNET_REST_jsonapi_resource_read_attr (json_res,
+                                                         GNUNET_REST_JSONAPI_NAMESTORE_RECORD);
+  if (NULL == records_json)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "No records given\n");
+    return GNUNET_SYSERR;
+  }
+  return json_to_gnsrecord (records_json, rd, rd_count);
+}
+
+/**
+ * Parse the body of a request into a JSONAPI object.
+ *
+ * @param handle the request
+ * @return NULL on error
+ */
+static struct JsonApiObject *
+parse_request_data (struct RequestHandle *handle)
+{
+  struct JsonApiObject *json_obj;
   char term_data[handle->data_size+1];
 
   if (strlen (GNUNET_REST_API_NS_NAMESTORE) != strlen (handle->url))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 "Cannot create under %s\n", handle->url);
-    GNUNET_SCHEDULER_add_now (&do_error, handle);
-    return;
+    return NULL;
   }
   if (0 >= handle->data_size)
-  {
-    GNUNET_SCHEDULER_add_now (&do_error, handle);
-    return;
-  }
+    return NULL;
   term_data[handle->data_size] = '\0';
   memcpy (term_data, handle->data, handle->data_size);
   json_obj = GNUNET_REST_jsonapi_object_parse (term_data);
   if (NULL == json_obj)
-  {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 "Unable to parse JSONAPI Object from %s\n",
                 term_data);
+  return json_obj;
+}
+
+static void
+namestore_create_cont (struct RestConnectionDataHandle *con,
+                       const char *url,
+                       void *cls)
+{
+  struct RequestHandle *handle = cls;
+  struct MHD_Response *resp;
+  struct JsonApiObject *json_obj;
+  struct JsonApiResource *json_res;
+  int ret;
+
+  json_obj = parse_request_data (handle);
+  if (NULL == json_obj)
+  {
     GNUNET_SCHEDULER_add_now (&do_error, handle);
     return;
   }
@@ -717,55 +934,141 @@ namestore_create_cont (struct RestConnectionDataHandle *con,
     return;
   }
   json_res = GNUNET_REST_jsonapi_object_get_resource (json_obj, 0);
-  if (GNUNET_NO == GNUNET_REST_jsonapi_resource_check_type (json_res,
-                                                            GNUNET_REST_JSONAPI_NAMESTORE_RECORD))
+  GNUNET_free_non_null (handle->name);
+  handle->name = NULL;
+  ret = json_to_named_records (json_res,
+                               &handle->name,
+                               &handle->rd,
+                               &handle->rd_count);
+  GNUNET_REST_jsonapi_object_delete (json_obj);
+  if (GNUNET_NO == ret)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                "Unsupported JSON data type\n");
-    GNUNET_REST_jsonapi_object_delete (json_obj);
     resp = GNUNET_REST_create_json_response (NULL);
     handle->proc (handle->proc_cls, resp, MHD_HTTP_CONFLICT);
     cleanup_handle (handle);
     return;
   }
-  name_json = GNUNET_REST_jsonapi_resource_read_attr (json_res, GNUNET_REST_JSONAPI_KEY_ID);
-  if (!json_is_string (name_json))
+  if (GNUNET_SYSERR == ret)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                "Name property is no string\n");
-    GNUNET_REST_jsonapi_object_delete (json_obj); 
     GNUNET_SCHEDULER_add_now (&do_error, handle);
     return;
   }
-  GNUNET_asprintf (&handle->name, "%s", json_string_value (name_json));
-  records_json = GNUNET_REST_jsonapi_resource_read_attr (json_res,
-                                                         GNUNET_REST_JSONAPI_NAMESTORE_RECORD);
-  if (NULL == records_json)
+
+  handle->add_qe = GNUNET_NAMESTORE_records_lookup (handle->ns_handle,
+                                                    &handle->zone_pkey,
+                                                    handle->name,
+                                                    &create_new_record_cont, handle );
+}
+
+
+
+/**
+ * Continuation called once the records of one name of a
+ * bulk update were stored.
+ *
+ * @param cls the `struct BulkEntry`
+ * @param success #GNUNET_YES on success
+ * @param emsg error message, NULL on success
+ */
+static void
+update_finished (void *cls, int32_t success, const char *emsg)
+{
+  struct BulkEntry *entry = cls;
+  struct RequestHandle *handle = entry->handle;
+
+  entry->qe = NULL;
+  if (GNUNET_YES != success)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                "No records given\n");
-    GNUNET_REST_jsonapi_object_delete (json_obj);
+                "Error storing records for `%s'%s%s\n",
+                entry->name,
+                (NULL == emsg) ? "" : ": ",
+                (NULL == emsg) ? "" : emsg);
+    handle->bulk_failed = GNUNET_YES;
+  }
+  GNUNET_CONTAINER_DLL_remove (handle->bulk_head,
+                               handle->bulk_tail,
+                               entry);
+  if (NULL != entry->rd)
+    free_records (entry->rd, entry->rd_count);
+  GNUNET_free (entry->name);
+  GNUNET_free (entry);
+  if (NULL != handle->bulk_head)
+    return;
+  if (GNUNET_YES == handle->bulk_failed)
+  {
     GNUNET_SCHEDULER_add_now (&do_error, handle);
     return;
   }
-  if (GNUNET_SYSERR == json_to_gnsrecord (records_json, &handle->rd, &handle->rd_count))
+  handle->proc (handle->proc_cls,
+                GNUNET_REST_create_json_response (NULL),
+                MHD_HTTP_NO_CONTENT);
+  GNUNET_SCHEDULER_add_now (&cleanup_handle_delayed, handle);
+}
+
+/**
+ * Replace the records of all names given in the request.  Unlike
+ * a POST, the request may contain any number of resources and
+ * existing records are overwritten.  All store operations are
+ * queued at once on the shared namestore connection.
+ *
+ * @param con the connection
+ * @param url the url
+ * @param cls the `struct RequestHandle`
+ */
+static void
+namestore_update_cont (struct RestConnectionDataHandle *con,
+                       const char *url,
+                       void *cls)
+{
+  struct RequestHandle *handle = cls;
+  struct JsonApiObject *json_obj;
+  struct BulkEntry *entry;
+  int count;
+  int i;
+
+  json_obj = parse_request_data (handle);
+  if (NULL == json_obj)
+  {
+    GNUNET_SCHEDULER_add_now (&do_error, handle);
+    return;
+  }
+  count = GNUNET_REST_jsonapi_object_resource_count (json_obj);
+  if (0 >= count)
   {
     GNUNET_REST_jsonapi_object_delete (json_obj);
     GNUNET_SCHEDULER_add_now (&do_error, handle);
     return;
   }
+  for (i = 0; i < count; i++)
+  {
+    entry = GNUNET_new (struct BulkEntry);
+    entry->handle = handle;
+    GNUNET_CONTAINER_DLL_insert_tail (handle->bulk_head,
+                                      handle->bulk_tail,
+                                      entry);
+    if (GNUNET_OK !=
+        json_to_named_records (GNUNET_REST_jsonapi_object_get_resource (json_obj, i),
+                               &entry->name,
+                               &entry->rd,
+                               &entry->rd_count))
+    {
+      GNUNET_REST_jsonapi_object_delete (json_obj);
+      GNUNET_SCHEDULER_add_now (&do_error, handle);
+      return;
+    }
+  }
   GNUNET_REST_jsonapi_object_delete (json_obj);
-
-  handle->add_qe = GNUNET_NAMESTORE_records_lookup (handle->ns_handle,
-                                                    &handle->zone_pkey,
-                                                    handle->name,
-                                                    &create_new_record_cont, handle );
+  for (entry = handle->bulk_head; NULL != entry; entry = entry->next)
+    entry->qe = GNUNET_NAMESTORE_records_store (handle->ns_handle,
+                                                &handle->zone_pkey,
+                                                entry->name,
+                                                entry->rd_count,
+                                                entry->rd,
+                                                &update_finished,
+                                                entry);
 }
 
-
-
-
-
 static void
 namestore_info_cont (struct RestConnectionDataHandle *con,
                      const char *url,
@@ -787,80 +1090,40 @@ get_name_from_url (const char* url)
 }
 
 /**
- * Function called with the result from the check if the namestore
- * service is actually running.  If it is, we start the actual
- * operation.
+ * We know the zone of the request, process it.
  *
- * @param cls closure with our configuration
- * @param result #GNUNET_YES if the namestore service is running
+ * @param handle the request
  */
 static void
-testservice_task (void *cls,
-                  int result)
+process_zone_request (struct RequestHandle *handle)
 {
-  struct RequestHandle *handle = cls;
   static const struct GNUNET_REST_RestConnectionHandler handlers[] = {
     {MHD_HTTP_METHOD_GET, GNUNET_REST_API_NS_NAMESTORE, &namestore_info_cont}, //list
     {MHD_HTTP_METHOD_POST, GNUNET_REST_API_NS_NAMESTORE, &namestore_create_cont}, //create
-    //    {MHD_HTTP_METHOD_PUT, GNUNET_REST_API_NS_NAMESTORE, &namestore_edit_cont}, //update. TODO this shoul be PATCH
+    {MHD_HTTP_METHOD_PUT, GNUNET_REST_API_NS_NAMESTORE, &namestore_update_cont}, //bulk update
     {MHD_HTTP_METHOD_DELETE, GNUNET_REST_API_NS_NAMESTORE, &namestore_delete_cont}, //delete
     GNUNET_REST_HANDLER_END
   };
 
-  if (GNUNET_YES != result)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("Service `%s' is not running\n"),
-                "namestore");
-    GNUNET_SCHEDULER_add_now (&do_error, handle);
-    return;
-  }
-  handle->ns_handle = GNUNET_NAMESTORE_connect (cfg);
-  if (NULL == handle->ns_handle)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                _("Failed to connect to namestore\n"));
-    GNUNET_SCHEDULER_add_now (&do_error, handle);
-    return;
-  }
-
+  handle->ns_handle = plugin.ns_handle;
   if (GNUNET_NO == GNUNET_REST_handle_request (handle->conndata_handle, handlers, handle))
     GNUNET_SCHEDULER_add_now (&do_error, (void*) handle);
 
 }
 
 /**
- * Callback invoked from identity service with ego information.
- * An @a ego of NULL means the ego was not found.
+ * Answer a request with "404 Not found".
  *
- * @param cls closure with the configuration
- * @param ego an ego known to identity service, or NULL
+ * @param handle the request
  */
 static void
-identity_cb (void *cls,
-             const struct GNUNET_IDENTITY_Ego *ego)
+do_not_found (struct RequestHandle *handle)
 {
-  struct RequestHandle *handle = cls;
   struct MHD_Response *resp;
 
-  handle->ego_lookup = NULL;
-  if (NULL == ego)
-  {
-    if (NULL != handle->ego_name)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                  _("Ego `%s' not known to identity service\n"),
-                  handle->ego_name);
-    }
-    resp = GNUNET_REST_create_json_response (NULL);
-    handle->proc (handle->proc_cls, resp, MHD_HTTP_NOT_FOUND);
-    cleanup_handle (handle);
-    return;
-  }
-  handle->zone_pkey = *GNUNET_IDENTITY_ego_get_private_key (ego);
-  GNUNET_CLIENT_service_test ("namestore", handle->cfg,
-                              GNUNET_TIME_UNIT_SECONDS,
-                              &testservice_task,
-                              (void *) handle);
+  resp = GNUNET_REST_create_json_response (NULL);
+  handle->proc (handle->proc_cls, resp, MHD_HTTP_NOT_FOUND);
+  cleanup_handle (handle);
 }
 
 static void
@@ -870,90 +1133,138 @@ default_ego_cb (void *cls,
                 const char *name)
 {
   struct RequestHandle *handle = cls;
-  struct MHD_Response *resp;
+
   handle->get_default = NULL;
   if (NULL == ego)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 _("No default ego configured in identity service\n"));
-    resp = GNUNET_REST_create_json_response (NULL);
-    handle->proc (handle->proc_cls, resp, MHD_HTTP_NOT_FOUND);
-    cleanup_handle (handle);
+    do_not_found (handle);
     return;
   }
-  else
-  {
-    identity_cb (cls, ego);
-  }
+  handle->zone_pkey = *GNUNET_IDENTITY_ego_get_private_key (ego);
+  process_zone_request (handle);
 }
 
+/**
+ * Find the zone of a request in the list of egos.
+ *
+ * @param handle the request
+ */
 static void
-id_connect_cb (void *cls,
-               struct GNUNET_IDENTITY_Ego *ego,
-               void **ctx,
-               const char *name)
+resolve_zone (struct RequestHandle *handle)
 {
-  struct RequestHandle *handle = cls;
-  if (NULL == ego)
+  struct EgoEntry *ego_entry;
+
+  if (NULL == handle->ego_name)
   {
-    handle->get_default = GNUNET_IDENTITY_get (handle->identity_handle,
+    handle->get_default = GNUNET_IDENTITY_get (plugin.identity_handle,
                                                "namestore",
                                                &default_ego_cb, handle);
+    return;
   }
+  for (ego_entry = plugin.ego_head; NULL != ego_entry; ego_entry = ego_entry->next)
+    if (0 == strcmp (ego_entry->name, handle->ego_name))
+      break;
+  if (NULL == ego_entry)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Ego `%s' not known to identity service\n"),
+                handle->ego_name);
+    do_not_found (handle);
+    return;
+  }
+  handle->zone_pkey = ego_entry->pkey;
+  process_zone_request (handle);
 }
 
+/**
+ * Called by the identity service for each ego, and whenever an ego
+ * changes.  Keeps our list of egos up to date.
+ *
+ * @param cls NULL
+ * @param ego the ego, NULL at the end of the initial list
+ * @param ctx our `struct EgoEntry` for @a ego
+ * @param name name of the ego, NULL if it was deleted
+ */
 static void
-testservice_id_task (void *cls, int result)
+id_connect_cb (void *cls,
+               struct GNUNET_IDENTITY_Ego *ego,
+               void **ctx,
+               const char *name)
 {
-  struct RequestHandle *handle = cls;
-  struct MHD_Response *resp;
-  struct GNUNET_HashCode key;
-  char *ego;
-  char *name;
+  struct EgoEntry *ego_entry;
+  struct RequestHandle *handle;
 
-  if (result != GNUNET_YES)
+  if (NULL == ego)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                _("Identity service is not running\n"));
-    resp = GNUNET_REST_create_json_response (NULL);
-    handle->proc (handle->proc_cls, resp, MHD_HTTP_NOT_FOUND);
-    cleanup_handle (handle);
+    plugin.egos_complete = GNUNET_YES;
+    while (NULL != (handle = plugin.waiting_head))
+    {
+      GNUNET_CONTAINER_DLL_remove (plugin.waiting_head,
+                                   plugin.waiting_tail,
+                                   handle);
+      handle->waiting = GNUNET_NO;
+      resolve_zone (handle);
+    }
     return;
   }
-  ego = NULL;
-  GNUNET_CRYPTO_hash (GNUNET_REST_JSONAPI_NAMESTORE_EGO,
-                      strlen (GNUNET_REST_JSONAPI_NAMESTORE_EGO),
-                      &key);
-  if ( GNUNET_YES == 
-       GNUNET_CONTAINER_multihashmap_contains (handle->conndata_handle->url_param_map,
-                                               &key) )
+  ego_entry = *ctx;
+  if (NULL == ego_entry)
   {
-    ego = GNUNET_CONTAINER_multihashmap_get (handle->conndata_handle->url_param_map,
-                                             &key);
+    if (NULL == name)
+      return;
+    ego_entry = GNUNET_new (struct EgoEntry);
+    ego_entry->pkey = *GNUNET_IDENTITY_ego_get_private_key (ego);
+    GNUNET_CONTAINER_DLL_insert_tail (plugin.ego_head,
+                                      plugin.ego_tail,
+                                      ego_entry);
+    *ctx = ego_entry;
   }
-  name = get_name_from_url (handle->url);
-  if (NULL != ego)
-    GNUNET_asprintf (&handle->ego_name, "%s", ego);
-  if (NULL != name)
-    GNUNET_asprintf (&handle->name, "%s", name);
-  GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "%s\n", handle->ego_name);
-  if (NULL == handle->ego_name)
+  else
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "%s\n", handle->ego_name);
-    handle->identity_handle = GNUNET_IDENTITY_connect (handle->cfg, &id_connect_cb, handle);
-    if (NULL == handle->identity_handle)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR, _("Cannot connect to identity service\n"));
-      resp = GNUNET_REST_create_json_response (NULL);
-      handle->proc (handle->proc_cls, resp, MHD_HTTP_NOT_FOUND);
-      cleanup_handle (handle);
-    }
+    GNUNET_free (ego_entry->name);
+    ego_entry->name = NULL;
+  }
+  if (NULL == name)
+  {
+    GNUNET_CONTAINER_DLL_remove (plugin.ego_head,
+                                 plugin.ego_tail,
+                                 ego_entry);
+    GNUNET_free (ego_entry);
+    *ctx = NULL;
     return;
   }
-  handle->ego_lookup = GNUNET_IDENTITY_ego_lookup (cfg,
-                                                   handle->ego_name,
-                                                   &identity_cb,
-                                                   handle);
+  ego_entry->name = GNUNET_strdup (name);
+}
+
+/**
+ * Connect to the services unless we are already connected.
+ *
+ * @return #GNUNET_OK on success
+ */
+static int
+connect_services ()
+{
+  if (NULL == plugin.ns_handle)
+    plugin.ns_handle = GNUNET_NAMESTORE_connect (cfg);
+  if (NULL == plugin.ns_handle)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Failed to connect to namestore\n"));
+    return GNUNET_SYSERR;
+  }
+  if (NULL == plugin.identity_handle)
+    plugin.identity_handle = GNUNET_IDENTITY_connect (cfg,
+                                                      &id_connect_cb,
+                                                      NULL);
+  if (NULL == plugin.identity_handle)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Cannot connect to identity service\n"));
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
 }
 
 /**
@@ -973,8 +1284,11 @@ rest_identity_process_request(struct RestConnectionDataHandle *conndata_handle,
                               void *proc_cls)
 {
   struct RequestHandle *handle = GNUNET_new (struct RequestHandle);
+  struct GNUNET_HashCode key;
+  char *ego;
+  char *name;
 
-  handle->timeout = GNUNET_TIME_UNIT_FOREVER_REL;
+  handle->timeout = REQUEST_TIMEOUT;
   handle->proc_cls = proc_cls;
   handle->proc = proc;
   handle->conndata_handle = conndata_handle;
@@ -983,19 +1297,40 @@ rest_identity_process_request(struct RestConnectionDataHandle *conndata_handle,
   GNUNET_asprintf (&handle->url, "%s", conndata_handle->url);
   if (handle->url[strlen (handle->url)-1] == '/')
     handle->url[strlen (handle->url)-1] = '\0';
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Connecting...\n");
   handle->cfg = cfg;
-  GNUNET_CLIENT_service_test ("identity",
-                              cfg,
-                              GNUNET_TIME_UNIT_SECONDS,
-                              &testservice_id_task,
-                              handle);
+  if (GNUNET_OK != connect_services ())
+  {
+    do_not_found (handle);
+    return;
+  }
+  ego = NULL;
+  GNUNET_CRYPTO_hash (GNUNET_REST_JSONAPI_NAMESTORE_EGO,
+                      strlen (GNUNET_REST_JSONAPI_NAMESTORE_EGO),
+                      &key);
+  if ( GNUNET_YES ==
+       GNUNET_CONTAINER_multihashmap_contains (handle->conndata_handle->url_param_map,
+                                               &key) )
+  {
+    ego = GNUNET_CONTAINER_multihashmap_get (handle->conndata_handle->url_param_map,
+                                             &key);
+  }
+  name = get_name_from_url (handle->url);
+  if (NULL != ego)
+    GNUNET_asprintf (&handle->ego_name, "%s", ego);
+  if (NULL != name)
+    GNUNET_asprintf (&handle->name, "%s", name);
   handle->timeout_task = GNUNET_SCHEDULER_add_delayed (handle->timeout,
                                                        &do_error,
                                                        handle);
-
-
+  if (GNUNET_YES != plugin.egos_complete)
+  {
+    handle->waiting = GNUNET_YES;
+    GNUNET_CONTAINER_DLL_insert_tail (plugin.waiting_head,
+                                      plugin.waiting_tail,
+                                      handle);
+    return;
+  }
+  resolve_zone (handle);
 }
 
 /**
@@ -1007,7 +1342,6 @@ rest_identity_process_request(struct RestConnectionDataHandle *conndata_handle,
 void *
 libgnunet_plugin_rest_namestore_init (void *cls)
 {
-  static struct Plugin plugin;
   cfg = cls;
   struct GNUNET_REST_Plugin *api;
 
@@ -1036,7 +1370,26 @@ libgnunet_plugin_rest_namestore_done (void *cls)
 {
   struct GNUNET_REST_Plugin *api = cls;
   struct Plugin *plugin = api->cls;
+  struct RequestHandle *handle;
+  struct EgoEntry *ego_entry;
 
+  while (NULL != (handle = plugin->waiting_head))
+    cleanup_handle (handle);
+  if (NULL != plugin->identity_handle)
+    GNUNET_IDENTITY_disconnect (plugin->identity_handle);
+  if (NULL != plugin->ns_handle)
+    GNUNET_NAMESTORE_disconnect (plugin->ns_handle);
+  while (NULL != (ego_entry = plugin->ego_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (plugin->ego_head,
+                                 plugin->ego_tail,
+                                 ego_entry);
+    GNUNET_free (ego_entry->name);
+    GNUNET_free (ego_entry);
+  }
+  plugin->identity_handle = NULL;
+  plugin->ns_handle = NULL;
+  plugin->egos_complete = GNUNET_NO;
   plugin->cfg = NULL;
   GNUNET_free (api);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
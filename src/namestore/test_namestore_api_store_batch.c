@@ -0,0 +1,220 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file namestore/test_namestore_api_store_batch.c
+ * @brief testcase for namestore_api.c: store several labels at once
+ */
+#include "platform.h"
+#include "gnunet_namestore_service.h"
+#include "gnunet_testing_lib.h"
+
+#define TEST_RECORD_TYPE 1234
+
+#define TEST_RECORD_DATALEN 123
+
+#define TEST_RECORD_DATA 'a'
+
+#define TEST_LABELS 3
+
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 100)
+
+
+static struct GNUNET_NAMESTORE_Handle *nsh;
+
+static struct GNUNET_SCHEDULER_Task * endbadly_task;
+
+static struct GNUNET_CRYPTO_EcdsaPrivateKey *privkey;
+
+static int res;
+
+static struct GNUNET_NAMESTORE_QueueEntry *nsqe;
+
+static char *directory;
+
+static const char *labels[TEST_LABELS] = { "alpha", "bravo", "charlie" };
+
+static unsigned int lookup_off;
+
+
+static void
+cleanup ()
+{
+  if (NULL != nsh)
+  {
+    GNUNET_NAMESTORE_disconnect (nsh);
+    nsh = NULL;
+  }
+  if (NULL != privkey)
+  {
+    GNUNET_free (privkey);
+    privkey = NULL;
+  }
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+static void
+endbadly (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  if (NULL != nsqe)
+  {
+    GNUNET_NAMESTORE_cancel (nsqe);
+    nsqe = NULL;
+  }
+  cleanup ();
+  res = 1;
+}
+
+
+static void
+end (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  cleanup ();
+  res = 0;
+}
+
+
+static void
+lookup_it (void *cls,
+           const struct GNUNET_CRYPTO_EcdsaPrivateKey *zone,
+           const char *label,
+           unsigned int rd_count,
+           const struct GNUNET_GNSRECORD_Data *rd)
+{
+  nsqe = NULL;
+  if ( (NULL == label) ||
+       (0 != strcmp (label, labels[lookup_off])) ||
+       (1 != rd_count) ||
+       (TEST_RECORD_TYPE != rd[0].record_type) ||
+       (TEST_RECORD_DATALEN != rd[0].data_size) )
+  {
+    GNUNET_break (0);
+    GNUNET_SCHEDULER_cancel (endbadly_task);
+    endbadly_task = GNUNET_SCHEDULER_add_now (&endbadly, NULL);
+    return;
+  }
+  if (TEST_LABELS == ++lookup_off)
+  {
+    GNUNET_SCHEDULER_cancel (endbadly_task);
+    endbadly_task = NULL;
+    GNUNET_SCHEDULER_add_now (&end, NULL);
+    return;
+  }
+  nsqe = GNUNET_NAMESTORE_records_lookup (nsh, privkey,
+                                          labels[lookup_off],
+                                          &lookup_it, NULL);
+}
+
+
+static void
+put_cont (void *cls, int32_t success, const char *emsg)
+{
+  nsqe = NULL;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Name store added batch of records: %s\n",
+	      (success == GNUNET_OK) ? "SUCCESS" : "FAIL");
+  if (GNUNET_OK != success)
+  {
+    GNUNET_break (0);
+    GNUNET_SCHEDULER_cancel (endbadly_task);
+    endbadly_task = GNUNET_SCHEDULER_add_now (&endbadly, NULL);
+    return;
+  }
+  lookup_off = 0;
+  nsqe = GNUNET_NAMESTORE_records_lookup (nsh, privkey,
+                                          labels[lookup_off],
+                                          &lookup_it, NULL);
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_CONFIGURATION_Handle *cfg,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  struct GNUNET_GNSRECORD_Data rd;
+  struct GNUNET_NAMESTORE_RecordSet sets[TEST_LABELS];
+  char *hostkey_file;
+  unsigned int i;
+
+  directory = NULL;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_get_value_string(cfg, "PATHS", "GNUNET_TEST_HOME", &directory));
+  GNUNET_DISK_directory_remove (directory);
+
+  endbadly_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+						&endbadly, NULL);
+  GNUNET_asprintf (&hostkey_file,
+		   "zonefiles%s%s",
+		   DIR_SEPARATOR_STR,
+		   "N0UJMP015AFUNR2BTNM3FKPBLG38913BL8IDMCO2H0A1LIB81960.zkey");
+  privkey = GNUNET_CRYPTO_ecdsa_key_create_from_file (hostkey_file);
+  GNUNET_free (hostkey_file);
+  GNUNET_assert (privkey != NULL);
+
+  rd.expiration_time = GNUNET_TIME_absolute_get().abs_value_us;
+  rd.record_type = TEST_RECORD_TYPE;
+  rd.data_size = TEST_RECORD_DATALEN;
+  rd.data = GNUNET_malloc (TEST_RECORD_DATALEN);
+  rd.flags = 0;
+  memset ((char *) rd.data, TEST_RECORD_DATA, TEST_RECORD_DATALEN);
+  for (i=0;i<TEST_LABELS;i++)
+  {
+    sets[i].label = labels[i];
+    sets[i].rd_count = 1;
+    sets[i].rd = &rd;
+  }
+
+  nsh = GNUNET_NAMESTORE_connect (cfg);
+  GNUNET_break (NULL != nsh);
+  nsqe = GNUNET_NAMESTORE_records_store_batch (nsh, privkey,
+                                               TEST_LABELS, sets,
+                                               &put_cont, NULL);
+  if (NULL == nsqe)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+  	      _("Namestore cannot store batch\n"));
+  }
+  GNUNET_free ((void *)rd.data);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  res = 1;
+  if (0 !=
+      GNUNET_TESTING_peer_run ("test-namestore-api",
+                               "test_namestore_api.conf",
+                               &run,
+                               NULL))
+  {
+    res = 1;
+  }
+  if (NULL != directory)
+  {
+      GNUNET_DISK_directory_remove (directory);
+      GNUNET_free (directory);
+  }
+  return res;
+}
+
+
+/* end of test_namestore_api_store_batch.c */
@@ -116,6 +116,81 @@ get_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp, int id)
 }
 
 
+/**
+ * State of a test iteration with `iterate_records_after`.
+ */
+struct IterationState
+{
+  /**
+   * Zone of the last record seen.
+   */
+  struct GNUNET_CRYPTO_EcdsaPrivateKey last_zone;
+
+  /**
+   * Label of the last record seen, NULL at the start.
+   */
+  char *last_label;
+
+  /**
+   * Number of records seen.
+   */
+  unsigned int count;
+};
+
+
+static void
+check_iterated_record (void *cls,
+                       const struct GNUNET_CRYPTO_EcdsaPrivateKey *private_key,
+                       const char *label,
+                       unsigned int rd_count,
+                       const struct GNUNET_GNSRECORD_Data *rd)
+{
+  struct IterationState *is = cls;
+  int id;
+
+  GNUNET_assert (1 == sscanf (label, "a%d", &id));
+  test_record (&id, private_key, label, rd_count, rd);
+  if (NULL != is->last_label)
+    GNUNET_assert ( (0 < memcmp (private_key,
+                                 &is->last_zone,
+                                 sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) ||
+                    ( (0 == memcmp (private_key,
+                                    &is->last_zone,
+                                    sizeof (struct GNUNET_CRYPTO_EcdsaPrivateKey))) &&
+                      (0 < strcmp (label, is->last_label)) ) );
+  is->last_zone = *private_key;
+  GNUNET_free_non_null (is->last_label);
+  is->last_label = GNUNET_strdup (label);
+  is->count++;
+}
+
+
+static void
+iterate_records_after (struct GNUNET_NAMESTORE_PluginFunctions *nsp,
+                       unsigned int expected)
+{
+  struct IterationState is;
+  int ret;
+
+  if (NULL == nsp->iterate_records_after)
+    return;
+  memset (&is, 0, sizeof (is));
+  do
+  {
+    ret = nsp->iterate_records_after (nsp->cls,
+                                      NULL,
+                                      (NULL == is.last_label) ? NULL : &is.last_zone,
+                                      is.last_label,
+                                      2,
+                                      &check_iterated_record, &is);
+    GNUNET_assert (GNUNET_SYSERR != ret);
+  }
+  while (GNUNET_OK == ret);
+  GNUNET_assert (is.count >= expected);
+  GNUNET_free_non_null (is.last_label);
+}
+
+
 static void
 put_record (struct GNUNET_NAMESTORE_PluginFunctions *nsp, int id)
 {
@@ -163,6 +238,11 @@ run (void *cls, char *const *args, const char *cfgfile,
   }
   put_record (nsp, 1);
   get_record (nsp, 1);
+  put_record (nsp, 2);
+  put_record (nsp, 3);
+  put_record (nsp, 4);
+  put_record (nsp, 5);
+  iterate_records_after (nsp, 5);
 
   unload_plugin (nsp);
 }
@@ -61,6 +61,12 @@
  */
 #define STUN_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 2)
 
+/**
+ * How long do we trust an external address discovered earlier
+ * (and stored in the EXTERNAL_ADDRESS_CACHE file)?
+ */
+#define EXTERNAL_ADDRESS_CACHE_TTL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_HOURS, 1)
+
 
 /**
  * Where did the given local address originate from?
@@ -88,6 +94,13 @@ enum LocalAddressSource
    */
   LAL_EXTERNAL_IP_OLD,
 
+  /**
+   * Address was discovered (via STUN or UPnP) by an earlier run and
+   * loaded from the EXTERNAL_ADDRESS_CACHE file; replaced as soon
+   * as a fresh discovery succeeds.
+   */
+  LAL_EXTERNAL_CACHED,
+
   /**
    * Address was obtained by looking up our own hostname in DNS.
    */
@@ -205,6 +218,27 @@ struct StunServerList
 };
 
 
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Format of the EXTERNAL_ADDRESS_CACHE file.
+ */
+struct ExternalAddressCache
+{
+  /**
+   * Until when is the address considered valid?
+   */
+  struct GNUNET_TIME_AbsoluteNBO expiration;
+
+  /**
+   * The external IPv4 address we discovered.
+   */
+  struct in_addr addr;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * Handle for active NAT registrations.
  */
@@ -441,6 +475,28 @@ struct GNUNET_NAT_Handle
    */
   struct StunServerList *actual_stun_server;
 
+  /**
+   * Did any STUN server answer yet?  Until then, all servers are
+   * asked in parallel.
+   */
+  int have_stun_answer;
+
+  /**
+   * File with the external address we discovered last, NULL
+   * if we do not cache it.
+   */
+  char *ext_cache_file;
+
+  /**
+   * How long is a discovered external address cached?
+   */
+  struct GNUNET_TIME_Relative ext_cache_ttl;
+
+  /**
+   * Task loading the cached external address.
+   */
+  struct GNUNET_SCHEDULER_Task *ext_cache_task;
+
 };
 
 
@@ -656,6 +712,103 @@ static void
 resolve_dns (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
 
 
+/**
+ * We freshly discovered our external IPv4 address.  Drop the
+ * address we loaded from the cache and remember the new one for
+ * the next start (and for the other transports of this peer).
+ *
+ * @param h handle to NAT
+ * @param addr the external address
+ */
+static void
+store_external_address (struct GNUNET_NAT_Handle *h,
+                        const struct in_addr *addr)
+{
+  struct ExternalAddressCache cache;
+
+  if (NULL != h->ext_cache_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->ext_cache_task);
+    h->ext_cache_task = NULL;
+  }
+  remove_from_address_list_by_source (h, LAL_EXTERNAL_CACHED);
+  if (NULL == h->ext_cache_file)
+    return;
+  cache.expiration = GNUNET_TIME_absolute_hton
+    (GNUNET_TIME_relative_to_absolute (h->ext_cache_ttl));
+  cache.addr = *addr;
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (h->ext_cache_file))
+    return;
+  if (sizeof (cache) !=
+      GNUNET_DISK_fn_write (h->ext_cache_file,
+                            &cache,
+                            sizeof (cache),
+                            GNUNET_DISK_PERM_USER_READ |
+                            GNUNET_DISK_PERM_USER_WRITE))
+    GNUNET_log_from_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                   "nat",
+                                   "write",
+                                   h->ext_cache_file);
+}
+
+
+/**
+ * Task that drops the cached external address once it expired.
+ *
+ * @param cls the NAT handle
+ * @param tc scheduler context
+ */
+static void
+expire_external_address (void *cls,
+                         const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_NAT_Handle *h = cls;
+
+  h->ext_cache_task = NULL;
+  remove_from_address_list_by_source (h, LAL_EXTERNAL_CACHED);
+}
+
+
+/**
+ * Task that adds the external address discovered by an earlier run
+ * (if it has not expired), so that we can advertise it right away
+ * instead of waiting for STUN or UPnP.
+ *
+ * @param cls the NAT handle
+ * @param tc scheduler context
+ */
+static void
+load_external_address (void *cls,
+                       const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_NAT_Handle *h = cls;
+  struct ExternalAddressCache cache;
+  struct GNUNET_TIME_Relative remaining;
+
+  h->ext_cache_task = NULL;
+  if (GNUNET_YES != GNUNET_DISK_file_test (h->ext_cache_file))
+    return;
+  if (sizeof (cache) !=
+      GNUNET_DISK_fn_read (h->ext_cache_file,
+                           &cache,
+                           sizeof (cache)))
+    return;
+  remaining = GNUNET_TIME_absolute_get_remaining
+    (GNUNET_TIME_absolute_ntoh (cache.expiration));
+  if (0 == remaining.rel_value_us)
+    return;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Using cached external address `%s'\n",
+       inet_ntoa (cache.addr));
+  add_ip_to_address_list (h, LAL_EXTERNAL_CACHED,
+                          &cache.addr, sizeof (struct in_addr));
+  h->ext_cache_task = GNUNET_SCHEDULER_add_delayed (remaining,
+                                                    &expire_external_address,
+                                                    h);
+}
+
+
 /**
  * Our (external) hostname was resolved and the configuration says that
  * the NAT was hole-punched.
@@ -1164,9 +1317,11 @@ GNUNET_NAT_is_valid_stun_packet(void *cls, const void *data, size_t len)
     LOG (GNUNET_ERROR_TYPE_INFO,
          "Stun server returned IP %s , with port %d \n", inet_ntoa(answer.sin_addr), ntohs(answer.sin_port));
     /* ADD IP AS VALID*/
+    store_external_address (h, &answer.sin_addr);
     add_to_address_list (h, LAL_EXTERNAL_IP, (const struct sockaddr *) &answer,
                          sizeof (struct sockaddr_in));
     h->waiting_stun = GNUNET_NO;
+    h->have_stun_answer = GNUNET_YES;
     return GNUNET_YES;
   }
   else
@@ -1192,10 +1347,30 @@ process_stun (void *cls,
 
   h->stun_task = NULL;
 
-
-
   struct StunServerList* elem = h->actual_stun_server;
 
+  if (NULL == elem)
+    return;
+  if (GNUNET_NO == h->have_stun_answer)
+  {
+    /* no answer yet: ask all servers at once, the first valid
+       reply wins (later ones are ignored, see #GNUNET_NAT_is_valid_stun_packet) */
+    for (elem = h->stun_servers_head; NULL != elem; elem = elem->next)
+    {
+      LOG (GNUNET_ERROR_TYPE_INFO,
+           "Requesting STUN server %s:%i\n", elem->address, elem->port);
+      if (GNUNET_OK == GNUNET_NAT_stun_make_request (elem->address, elem->port, h->socket, &stun_request_callback, NULL))
+        h->waiting_stun = GNUNET_YES;
+      else
+        LOG (GNUNET_ERROR_TYPE_ERROR,
+             "STUN request failed %s:%i !\n", elem->address, elem->port);
+    }
+    h->stun_task =
+      GNUNET_SCHEDULER_add_delayed (h->stun_frequency,
+                                    &process_stun, h);
+    return;
+  }
+
   /* Make the request */
   LOG (GNUNET_ERROR_TYPE_INFO,
        "I will request the stun server %s:%i !\n", elem->address, elem->port);
@@ -1311,6 +1486,9 @@ upnp_add (void *cls,
 
   if (GNUNET_YES == add_remove)
   {
+    if (sizeof (struct sockaddr_in) == addrlen)
+      store_external_address (h,
+                              &((const struct sockaddr_in *) addr)->sin_addr);
     add_to_address_list (h, LAL_UPNP, addr, addrlen);
     return;
   }
@@ -1717,6 +1895,26 @@ GNUNET_NAT_register (const struct GNUNET_CONFIGURATION_Handle *cfg,
 
   /* FIXME: add support for UPnP, etc */
 
+  /* Advertise the external address found by an earlier run (possibly
+     by another transport) while STUN/UPnP are still running */
+  if ( (NULL != h->address_callback) &&
+       ( (GNUNET_YES == h->behind_nat) ||
+         (GNUNET_YES == h->enable_upnp) ||
+         (NULL != h->actual_stun_server) ) )
+  {
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_time (cfg, "nat", "EXTERNAL_ADDRESS_CACHE_TTL",
+                                             &h->ext_cache_ttl))
+      h->ext_cache_ttl = EXTERNAL_ADDRESS_CACHE_TTL;
+    if ( (GNUNET_OK ==
+          GNUNET_CONFIGURATION_get_value_filename (cfg, "nat",
+                                                   "EXTERNAL_ADDRESS_CACHE",
+                                                   &h->ext_cache_file)) &&
+         (0 != h->ext_cache_ttl.rel_value_us) )
+      h->ext_cache_task = GNUNET_SCHEDULER_add_now (&load_external_address,
+                                                    h);
+  }
+
   if (NULL != h->address_callback)
   {
     h->ifc_task = GNUNET_SCHEDULER_add_now (&list_interfaces,
@@ -1790,6 +1988,11 @@ GNUNET_NAT_unregister (struct GNUNET_NAT_Handle *h)
     GNUNET_SCHEDULER_cancel (h->stun_task);
     h->stun_task = NULL;
   }
+  if (NULL != h->ext_cache_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->ext_cache_task);
+    h->ext_cache_task = NULL;
+  }
   if (NULL != h->server_proc)
   {
     if (0 != GNUNET_OS_process_kill (h->server_proc, GNUNET_TERM_SIG))
@@ -1821,6 +2024,7 @@ GNUNET_NAT_unregister (struct GNUNET_NAT_Handle *h)
   GNUNET_free_non_null (h->local_addrlens);
   GNUNET_free_non_null (h->external_address);
   GNUNET_free_non_null (h->internal_address);
+  GNUNET_free_non_null (h->ext_cache_file);
   GNUNET_free (h);
 }
 
@@ -49,6 +49,9 @@
 #endif
 #include "nse.h"
 #include <gcrypt.h>
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 
 /**
@@ -161,6 +164,82 @@ struct NSEPeerEntry
 };
 
 
+/**
+ * How many verified (public key, proof of work) pairs do we remember?
+ */
+#define POW_CACHE_SIZE 1024
+
+
+/**
+ * A (public key, proof of work) pair we verified before.
+ */
+struct PowCacheEntry
+{
+
+  /**
+   * Kept in a DLL, least recently used first.
+   */
+  struct PowCacheEntry *next;
+
+  /**
+   * Kept in a DLL, least recently used first.
+   */
+  struct PowCacheEntry *prev;
+
+  /**
+   * Hash of the public key and the proof, key in #pow_cache.
+   */
+  struct GNUNET_HashCode key;
+
+};
+
+
+/**
+ * A flood message whose proof of work and signature are being
+ * checked by the crypto offload pool.
+ */
+struct PendingVerification
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingVerification *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PendingVerification *prev;
+
+  /**
+   * The verification job.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Peers that sent us this message while we were verifying it.
+   */
+  struct GNUNET_PeerIdentity *senders;
+
+  /**
+   * Length of the @e senders array.
+   */
+  unsigned int num_senders;
+
+  /**
+   * The message being verified (defined below).
+   */
+  struct GNUNET_NSE_FloodMessage *msg;
+
+  /**
+   * #GNUNET_YES if the proof of work of @e msg is known to be
+   * valid, so that only the signature needs to be checked.
+   */
+  int pow_cached;
+
+};
+
+
 GNUNET_NETWORK_STRUCT_BEGIN
 
 /**
@@ -225,6 +304,32 @@ static const struct GNUNET_CONFIGURATION_Handle *cfg;
  */
 static struct GNUNET_STATISTICS_Handle *stats;
 
+/**
+ * Head of the flood messages being verified.
+ */
+static struct PendingVerification *pv_head;
+
+/**
+ * Tail of the flood messages being verified.
+ */
+static struct PendingVerification *pv_tail;
+
+/**
+ * Map of hashes of verified (public key, proof of work) pairs to
+ * their `struct PowCacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *pow_cache;
+
+/**
+ * Least recently used entry of #pow_cache.
+ */
+static struct PowCacheEntry *pce_head;
+
+/**
+ * Most recently used entry of #pow_cache.
+ */
+static struct PowCacheEntry *pce_tail;
+
 /**
  * Handle to the core service.
  */
@@ -278,7 +383,8 @@ static unsigned int estimate_count;
 static struct GNUNET_SCHEDULER_Task * flood_task;
 
 /**
- * Task scheduled to compute our proof.
+ * Task scheduled to compute our proof (or, if worker threads compute
+ * it, to check on their progress).
  */
 static struct GNUNET_SCHEDULER_Task * proof_task;
 
@@ -312,6 +418,85 @@ static struct GNUNET_PeerIdentity my_identity;
  */
 static uint64_t my_proof;
 
+#if HAVE_PTHREAD
+
+/**
+ * Maximum number of threads searching for our proof of work.
+ */
+#define MAX_PROOF_WORKERS 64
+
+/**
+ * How many proofs does a worker thread test before asking for more?
+ */
+#define PROOF_CHUNK_SIZE 1000
+
+/**
+ * How often do we check on (and save) the progress of the worker
+ * threads?
+ */
+#define PROOF_POLL_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 15)
+
+/**
+ * A thread searching for our proof of work.
+ */
+struct ProofWorker
+{
+
+  /**
+   * The thread.
+   */
+  pthread_t thread;
+
+  /**
+   * First proof of the chunk the thread is testing.
+   */
+  uint64_t chunk_start;
+
+  /**
+   * #GNUNET_YES while the thread is testing a chunk.
+   */
+  int active;
+
+};
+
+/**
+ * Threads searching for our proof of work, NULL if the proof is
+ * computed on the scheduler.
+ */
+static struct ProofWorker *proof_workers;
+
+/**
+ * Number of entries in #proof_workers.
+ */
+static unsigned int proof_worker_count;
+
+/**
+ * Protects the proof search state shared with the worker threads.
+ */
+static pthread_mutex_t proof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * First proof of the next chunk to hand out.
+ */
+static uint64_t proof_next;
+
+/**
+ * Proof found by the worker threads, valid if #proof_found is set.
+ */
+static uint64_t proof_result;
+
+/**
+ * #GNUNET_YES once a worker thread found a valid proof.
+ */
+static int proof_found;
+
+/**
+ * #GNUNET_YES if the worker threads should terminate.
+ */
+static int proof_stop;
+
+#endif
+
 /**
  * Handle to this serivce's server.
  */
@@ -972,40 +1157,451 @@ find_proof (void *cls,
 }
 
 
+#if HAVE_PTHREAD
+
+/**
+ * Main function of a thread searching for our proof of work.  Tests
+ * chunks of #PROOF_CHUNK_SIZE proofs handed out in ascending order
+ * until a proof is found or we are told to stop.  Must not log.
+ *
+ * @param cls the `struct ProofWorker`
+ * @return NULL
+ */
+static void *
+proof_worker_main (void *cls)
+{
+  struct ProofWorker *w = cls;
+  char buf[sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
+           sizeof (uint64_t)] GNUNET_ALIGN;
+  struct GNUNET_HashCode result;
+  uint64_t counter;
+  uint64_t end;
+  int done;
+#ifdef SCHED_IDLE
+  struct sched_param sp;
+
+  /* only use otherwise idle CPU time */
+  memset (&sp, 0, sizeof (sp));
+  (void) pthread_setschedparam (pthread_self (),
+                                SCHED_IDLE,
+                                &sp);
+#endif
+  memcpy (&buf[sizeof (uint64_t)], &my_identity,
+          sizeof (struct GNUNET_PeerIdentity));
+  while (1)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&proof_lock));
+    w->active = GNUNET_NO;
+    if ( (GNUNET_YES == proof_stop) ||
+         (GNUNET_YES == proof_found) ||
+         (UINT64_MAX == proof_next) )
+    {
+      GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+      return NULL;
+    }
+    counter = proof_next;
+    if (UINT64_MAX - counter < PROOF_CHUNK_SIZE)
+      end = UINT64_MAX;
+    else
+      end = counter + PROOF_CHUNK_SIZE;
+    proof_next = end;
+    w->chunk_start = counter;
+    w->active = GNUNET_YES;
+    GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+    for (; counter < end; counter++)
+    {
+      memcpy (buf, &counter, sizeof (uint64_t));
+      pow_hash (buf, sizeof (buf), &result);
+      GNUNET_assert (0 == pthread_mutex_lock (&proof_lock));
+      if (nse_work_required <= count_leading_zeroes (&result))
+      {
+        if ( (GNUNET_NO == proof_found) ||
+             (counter < proof_result) )
+          proof_result = counter;
+        proof_found = GNUNET_YES;
+      }
+      done = (GNUNET_YES == proof_stop) || (GNUNET_YES == proof_found);
+      GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+      if (done)
+        break;
+    }
+  }
+}
+
+
+/**
+ * Determine how far the worker threads got.  Must be called with
+ * #proof_lock held.
+ *
+ * @return smallest proof not yet known to be invalid
+ */
+static uint64_t
+get_proof_checkpoint ()
+{
+  uint64_t checkpoint;
+  unsigned int i;
+
+  if (GNUNET_YES == proof_found)
+    return proof_result;
+  checkpoint = proof_next;
+  for (i = 0; i < proof_worker_count; i++)
+    if ( (GNUNET_YES == proof_workers[i].active) &&
+         (proof_workers[i].chunk_start < checkpoint) )
+      checkpoint = proof_workers[i].chunk_start;
+  return checkpoint;
+}
+
+
+/**
+ * Stop all worker threads and set #my_proof to their progress.
+ */
+static void
+stop_proof_workers ()
+{
+  unsigned int i;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&proof_lock));
+  proof_stop = GNUNET_YES;
+  GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+  for (i = 0; i < proof_worker_count; i++)
+    GNUNET_break (0 == pthread_join (proof_workers[i].thread,
+                                     NULL));
+  my_proof = get_proof_checkpoint ();
+  GNUNET_free (proof_workers);
+  proof_workers = NULL;
+  proof_worker_count = 0;
+}
+
+
+/**
+ * Check on the threads searching for our proof of work.  Save their
+ * progress and start flooding once they found a proof.
+ *
+ * @param cls closure (unused)
+ * @param tc task context
+ */
+static void
+poll_proof_workers (void *cls,
+                    const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  uint64_t checkpoint;
+  int found;
+  int exhausted;
+
+  proof_task = NULL;
+  GNUNET_assert (0 == pthread_mutex_lock (&proof_lock));
+  found = proof_found;
+  checkpoint = get_proof_checkpoint ();
+  exhausted = (UINT64_MAX == checkpoint);
+  GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+  if ( (GNUNET_YES == found) ||
+       (exhausted) )
+  {
+    stop_proof_workers ();
+    write_proof ();
+    if (GNUNET_YES == found)
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Proof of work found: %llu!\n",
+                  (unsigned long long) GNUNET_ntohll (my_proof));
+      setup_flood_message (estimate_index, current_timestamp);
+    }
+    return;
+  }
+  if (checkpoint != my_proof)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Testing proofs currently at %llu\n",
+                (unsigned long long) checkpoint);
+    my_proof = checkpoint;
+    write_proof ();
+  }
+  proof_task = GNUNET_SCHEDULER_add_delayed (PROOF_POLL_FREQUENCY,
+                                             &poll_proof_workers,
+                                             NULL);
+}
+
+
+/**
+ * Start @a count threads searching for our proof of work, continuing
+ * from #my_proof.
+ *
+ * @param count number of threads to start
+ * @return #GNUNET_OK if at least one thread was started
+ */
+static int
+start_proof_workers (unsigned int count)
+{
+  unsigned int i;
+
+  proof_next = my_proof;
+  proof_found = GNUNET_NO;
+  proof_stop = GNUNET_NO;
+  proof_workers = GNUNET_new_array (count,
+                                    struct ProofWorker);
+  GNUNET_assert (0 == pthread_mutex_lock (&proof_lock));
+  for (i = 0; i < count; i++)
+  {
+    if (0 != pthread_create (&proof_workers[i].thread,
+                             NULL,
+                             &proof_worker_main,
+                             &proof_workers[i]))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "pthread_create");
+      break;
+    }
+  }
+  proof_worker_count = i;
+  GNUNET_assert (0 == pthread_mutex_unlock (&proof_lock));
+  if (0 == proof_worker_count)
+  {
+    GNUNET_free (proof_workers);
+    proof_workers = NULL;
+    return GNUNET_SYSERR;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Searching proof of work with %u threads\n",
+              proof_worker_count);
+  proof_task = GNUNET_SCHEDULER_add_delayed (PROOF_POLL_FREQUENCY,
+                                             &poll_proof_workers,
+                                             NULL);
+  return GNUNET_OK;
+}
+
+#endif
+
+
+/**
+ * Compute the key of the (public key, proof of work) pair of
+ * @a flood in #pow_cache.
+ *
+ * @param flood a flood message
+ * @param key set to the key
+ */
+static void
+get_pow_cache_key (const struct GNUNET_NSE_FloodMessage *flood,
+                   struct GNUNET_HashCode *key)
+{
+  char buf[sizeof (struct GNUNET_CRYPTO_EddsaPublicKey) +
+           sizeof (uint64_t)] GNUNET_ALIGN;
+
+  memcpy (buf, &flood->proof_of_work, sizeof (uint64_t));
+  memcpy (&buf[sizeof (uint64_t)], &flood->origin.public_key,
+          sizeof (struct GNUNET_CRYPTO_EddsaPublicKey));
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), key);
+}
+
+
+/**
+ * Check if we verified the proof of work of @a flood before.
+ *
+ * @param flood a flood message
+ * @return #GNUNET_YES if the proof of work is known to be valid
+ */
+static int
+pow_cache_check (const struct GNUNET_NSE_FloodMessage *flood)
+{
+  struct GNUNET_HashCode key;
+  struct PowCacheEntry *pce;
+
+  get_pow_cache_key (flood, &key);
+  pce = GNUNET_CONTAINER_multihashmap_get (pow_cache, &key);
+  if (NULL == pce)
+    return GNUNET_NO;
+  /* move to the end of the LRU list */
+  GNUNET_CONTAINER_DLL_remove (pce_head, pce_tail, pce);
+  GNUNET_CONTAINER_DLL_insert_tail (pce_head, pce_tail, pce);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Remember that the proof of work of @a flood is valid, evicting
+ * the least recently used entry if the cache is full.
+ *
+ * @param flood a verified flood message
+ */
+static void
+pow_cache_add (const struct GNUNET_NSE_FloodMessage *flood)
+{
+  struct PowCacheEntry *pce;
+
+  pce = GNUNET_new (struct PowCacheEntry);
+  get_pow_cache_key (flood, &pce->key);
+  if (GNUNET_OK !=
+      GNUNET_CONTAINER_multihashmap_put (pow_cache,
+                                         &pce->key,
+                                         pce,
+                                         GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
+  {
+    /* verified concurrently */
+    GNUNET_free (pce);
+    return;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (pce_head, pce_tail, pce);
+  if (GNUNET_CONTAINER_multihashmap_size (pow_cache) <= POW_CACHE_SIZE)
+    return;
+  pce = pce_head;
+  GNUNET_CONTAINER_DLL_remove (pce_head, pce_tail, pce);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (pow_cache,
+                                                       &pce->key,
+                                                       pce));
+  GNUNET_free (pce);
+}
+
+
 /**
  * An incoming flood message has been received which claims
  * to have more bits matching than any we know in this time
- * period.  Verify the signature and/or proof of work.
+ * period.  Verify the signature and, unless it is known to be
+ * valid, the proof of work.  Runs in the crypto offload pool,
+ * so must not log.
  *
- * @param incoming_flood the message to verify
+ * @param cls the `struct PendingVerification` to verify
  * @return #GNUNET_YES if the message is verified
  *         #GNUNET_NO if the key/signature don't verify
  */
 static int
-verify_message_crypto (const struct GNUNET_NSE_FloodMessage *incoming_flood)
+verify_message_crypto (void *cls)
+{
+  const struct PendingVerification *pv = cls;
+  const struct GNUNET_NSE_FloodMessage *incoming_flood = pv->msg;
+
+  if ( (GNUNET_YES != pv->pow_cached) &&
+       (GNUNET_YES !=
+        check_proof_of_work (&incoming_flood->origin.public_key,
+                             incoming_flood->proof_of_work)) )
+    return GNUNET_NO;
+  if ((nse_work_required > 0) &&
+      (GNUNET_OK !=
+       GNUNET_CRYPTO_eddsa_verify_nolog (GNUNET_SIGNATURE_PURPOSE_NSE_SEND,
+                                         &incoming_flood->purpose,
+                                         &incoming_flood->signature,
+                                         &incoming_flood->origin.public_key)))
+    return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Free a pending verification.
+ *
+ * @param pv verification to free
+ */
+static void
+free_verification (struct PendingVerification *pv)
+{
+  GNUNET_CONTAINER_DLL_remove (pv_head,
+                               pv_tail,
+                               pv);
+  if (NULL != pv->job)
+    GNUNET_CRYPTO_offload_cancel (pv->job);
+  GNUNET_array_grow (pv->senders,
+                     pv->num_senders,
+                     0);
+  GNUNET_free (pv->msg);
+  GNUNET_free (pv);
+}
+
+
+/**
+ * Process a flood message received from @a peer.
+ *
+ * @param peer peer the message is from
+ * @param incoming_flood the message
+ * @param verified #GNUNET_YES if the proof of work and the
+ *        signature were already verified
+ */
+static void
+process_flood (const struct GNUNET_PeerIdentity *peer,
+               const struct GNUNET_NSE_FloodMessage *incoming_flood,
+               int verified);
+
+
+/**
+ * The crypto offload pool is done verifying a flood message.
+ * Process it once for each peer that sent it to us.
+ *
+ * @param cls the `struct PendingVerification`
+ * @param result #GNUNET_YES if the message is verified
+ */
+static void
+verification_done (void *cls,
+                   int result)
 {
-  if (GNUNET_YES !=
-      check_proof_of_work (&incoming_flood->origin.public_key,
-                           incoming_flood->proof_of_work))
+  struct PendingVerification *pv = cls;
+  unsigned int i;
+
+  pv->job = NULL;
+  if (GNUNET_YES != result)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Proof of work invalid: %llu!\n",
+                "Proof of work or signature invalid: %llu!\n",
                 (unsigned long long)
-                GNUNET_ntohll (incoming_flood->proof_of_work));
+                GNUNET_ntohll (pv->msg->proof_of_work));
     GNUNET_break_op (0);
-    return GNUNET_NO;
+    for (i = 0; i < pv->num_senders; i++)
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Peer %s is likely ill-configured!\n",
+                  GNUNET_i2s (&pv->senders[i]));
   }
-  if ((nse_work_required > 0) &&
-      (GNUNET_OK !=
-       GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_NSE_SEND,
-                                 &incoming_flood->purpose,
-                                 &incoming_flood->signature,
-                                 &incoming_flood->origin.public_key)))
+  else
   {
-    GNUNET_break_op (0);
-    return GNUNET_NO;
+    if (GNUNET_YES != pv->pow_cached)
+      pow_cache_add (pv->msg);
+    for (i = 0; i < pv->num_senders; i++)
+      process_flood (&pv->senders[i],
+                     pv->msg,
+                     GNUNET_YES);
   }
-  return GNUNET_YES;
+  free_verification (pv);
+}
+
+
+/**
+ * Have the crypto offload pool verify a flood message from @a peer
+ * and process it again once it is verified.  If the same message
+ * is already being verified, just remember @a peer.
+ *
+ * @param peer peer the message is from
+ * @param incoming_flood the message
+ */
+static void
+start_verification (const struct GNUNET_PeerIdentity *peer,
+                    const struct GNUNET_NSE_FloodMessage *incoming_flood)
+{
+  struct PendingVerification *pv;
+
+  for (pv = pv_head; NULL != pv; pv = pv->next)
+    if (0 == memcmp (pv->msg,
+                     incoming_flood,
+                     sizeof (struct GNUNET_NSE_FloodMessage)))
+      break;
+  if (NULL == pv)
+  {
+    GNUNET_STATISTICS_update (stats,
+                              "# flood messages verified",
+                              1, GNUNET_NO);
+    pv = GNUNET_new (struct PendingVerification);
+    pv->msg = GNUNET_new (struct GNUNET_NSE_FloodMessage);
+    *pv->msg = *incoming_flood;
+    pv->pow_cached = pow_cache_check (incoming_flood);
+    if (GNUNET_YES == pv->pow_cached)
+      GNUNET_STATISTICS_update (stats,
+                                "# flood messages with cached proof of work",
+                                1, GNUNET_NO);
+    GNUNET_CONTAINER_DLL_insert (pv_head,
+                                 pv_tail,
+                                 pv);
+    pv->job = GNUNET_CRYPTO_offload (&verify_message_crypto,
+                                     pv,
+                                     &verification_done,
+                                     pv);
+  }
+  GNUNET_array_append (pv->senders,
+                       pv->num_senders,
+                       *peer);
 }
 
 
@@ -1067,10 +1663,9 @@ handle_p2p_size_estimate (void *cls,
                           const struct GNUNET_MessageHeader *message)
 {
   const struct GNUNET_NSE_FloodMessage *incoming_flood;
-  struct GNUNET_TIME_Absolute ts;
-  struct NSEPeerEntry *peer_entry;
+#if DEBUG_NSE
   uint32_t matching_bits;
-  unsigned int idx;
+#endif
 
 #if ENABLE_NSE_HISTOGRAM
   {
@@ -1085,8 +1680,8 @@ handle_p2p_size_estimate (void *cls,
 #endif
   incoming_flood = (const struct GNUNET_NSE_FloodMessage *) message;
   GNUNET_STATISTICS_update (stats, "# flood messages received", 1, GNUNET_NO);
-  matching_bits = ntohl (incoming_flood->matching_bits);
 #if DEBUG_NSE
+  matching_bits = ntohl (incoming_flood->matching_bits);
   {
     char origin[5];
     char pred[5];
@@ -1108,17 +1703,39 @@ handle_p2p_size_estimate (void *cls,
   }
 #endif
 
+  process_flood (peer,
+                 incoming_flood,
+                 GNUNET_NO);
+  return GNUNET_OK;
+}
+
+
+static void
+process_flood (const struct GNUNET_PeerIdentity *peer,
+               const struct GNUNET_NSE_FloodMessage *incoming_flood,
+               int verified)
+{
+  struct GNUNET_TIME_Absolute ts;
+  struct NSEPeerEntry *peer_entry;
+  uint32_t matching_bits;
+  unsigned int idx;
+
+  matching_bits = ntohl (incoming_flood->matching_bits);
   peer_entry = GNUNET_CONTAINER_multipeermap_get (peers, peer);
   if (NULL == peer_entry)
   {
-    GNUNET_break (0);
-    return GNUNET_OK;
+    /* the peer may have disconnected while we were verifying */
+    GNUNET_break (GNUNET_YES == verified);
+    return;
   }
 #if ENABLE_NSE_HISTOGRAM
-  peer_entry->received_messages++;
-  if (peer_entry->transmitted_messages > 0 &&
-      peer_entry->last_transmitted_size >= matching_bits)
-    GNUNET_STATISTICS_update(stats, "# cross messages", 1, GNUNET_NO);
+  if (GNUNET_YES != verified)
+  {
+    peer_entry->received_messages++;
+    if (peer_entry->transmitted_messages > 0 &&
+        peer_entry->last_transmitted_size >= matching_bits)
+      GNUNET_STATISTICS_update(stats, "# cross messages", 1, GNUNET_NO);
+  }
 #endif
 
   ts = GNUNET_TIME_absolute_ntoh (incoming_flood->timestamp);
@@ -1130,24 +1747,21 @@ handle_p2p_size_estimate (void *cls,
   else if (ts.abs_value_us == next_timestamp.abs_value_us)
   {
     if (matching_bits <= ntohl (next_message.matching_bits))
-      return GNUNET_OK;         /* ignore, simply too early/late */
-    if (GNUNET_YES != verify_message_crypto (incoming_flood))
+      return;         /* ignore, simply too early/late */
+    if (GNUNET_YES != verified)
     {
-      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-                  "Peer %s is likely ill-configured!\n",
-                  GNUNET_i2s (peer));
-      GNUNET_break_op (0);
-      return GNUNET_OK;
+      start_verification (peer, incoming_flood);
+      return;
     }
     next_message = *incoming_flood;
-    return GNUNET_OK;
+    return;
   }
   else
   {
     GNUNET_STATISTICS_update (stats,
                               "# flood messages discarded (clock skew too large)",
                               1, GNUNET_NO);
-    return GNUNET_OK;
+    return;
   }
   if (0 == (memcmp (peer, &my_identity, sizeof (struct GNUNET_PeerIdentity))))
   {
@@ -1156,7 +1770,7 @@ handle_p2p_size_estimate (void *cls,
         memcmp (&incoming_flood->origin,
 		&my_identity, sizeof (my_identity)))
       update_network_size_estimate ();
-    return GNUNET_OK;
+    return;
   }
   if (matching_bits == ntohl (size_estimate_messages[idx].matching_bits))
   {
@@ -1169,7 +1783,7 @@ handle_p2p_size_estimate (void *cls,
     {
       /* do not transmit information for the previous round to this peer
          anymore (but allow current round) */
-      return GNUNET_OK;
+      return;
     }
     /* got up-to-date information for current round, cancel transmission to
      * this peer altogether */
@@ -1183,7 +1797,7 @@ handle_p2p_size_estimate (void *cls,
       GNUNET_CORE_notify_transmit_ready_cancel (peer_entry->th);
       peer_entry->th = NULL;
     }
-    return GNUNET_OK;
+    return;
   }
   if (matching_bits < ntohl (size_estimate_messages[idx].matching_bits))
   {
@@ -1202,12 +1816,12 @@ handle_p2p_size_estimate (void *cls,
     GNUNET_STATISTICS_update (stats,
                               "# flood messages ignored (had closer already)",
                               1, GNUNET_NO);
-    return GNUNET_OK;
+    return;
   }
-  if (GNUNET_YES != verify_message_crypto (incoming_flood))
+  if (GNUNET_YES != verified)
   {
-    GNUNET_break_op (0);
-    return GNUNET_OK;
+    start_verification (peer, incoming_flood);
+    return;
   }
   GNUNET_assert (matching_bits >
                  ntohl (size_estimate_messages[idx].matching_bits));
@@ -1244,7 +1858,7 @@ handle_p2p_size_estimate (void *cls,
   /* flood to rest */
   GNUNET_CONTAINER_multipeermap_iterate (peers, &update_flood_times,
                                          peer_entry);
-  return GNUNET_OK;
+  return;
 }
 
 
@@ -1349,6 +1963,8 @@ static void
 shutdown_task (void *cls,
 	       const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  struct PowCacheEntry *pce;
+
   if (NULL != flood_task)
   {
     GNUNET_SCHEDULER_cancel (flood_task);
@@ -1358,8 +1974,14 @@ shutdown_task (void *cls,
   {
     GNUNET_SCHEDULER_cancel (proof_task);
     proof_task = NULL;
+#if HAVE_PTHREAD
+    if (NULL != proof_workers)
+      stop_proof_workers ();
+#endif
     write_proof ();             /* remember progress */
   }
+  while (NULL != pv_head)
+    free_verification (pv_head);
   if (NULL != nc)
   {
     GNUNET_SERVER_notification_context_destroy (nc);
@@ -1380,6 +2002,16 @@ shutdown_task (void *cls,
     GNUNET_CONTAINER_multipeermap_destroy (peers);
     peers = NULL;
   }
+  while (NULL != (pce = pce_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (pce_head, pce_tail, pce);
+    GNUNET_free (pce);
+  }
+  if (NULL != pow_cache)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (pow_cache);
+    pow_cache = NULL;
+  }
   if (NULL != my_private_key)
   {
     GNUNET_free (my_private_key);
@@ -1503,6 +2135,9 @@ run (void *cls,
   };
   char *proof;
   struct GNUNET_CRYPTO_EddsaPrivateKey *pk;
+#if HAVE_PTHREAD
+  unsigned long long worker_threads;
+#endif
 
   cfg = c;
   srv = server;
@@ -1589,11 +2224,23 @@ run (void *cls,
        GNUNET_DISK_fn_read (proof, &my_proof, sizeof (my_proof))))
     my_proof = 0;
   GNUNET_free (proof);
+#if HAVE_PTHREAD
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg, "NSE", "WORKTHREADS",
+                                             &worker_threads))
+    worker_threads = 0;
+  if (worker_threads > MAX_PROOF_WORKERS)
+    worker_threads = MAX_PROOF_WORKERS;
+  if ( (0 == worker_threads) ||
+       (GNUNET_OK != start_proof_workers ((unsigned int) worker_threads)) )
+#endif
   proof_task =
       GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
                                           &find_proof, NULL);
 
   peers = GNUNET_CONTAINER_multipeermap_create (128, GNUNET_NO);
+  pow_cache = GNUNET_CONTAINER_multihashmap_create (POW_CACHE_SIZE,
+                                                    GNUNET_NO);
   GNUNET_SERVER_add_handlers (srv, handlers);
   nc = GNUNET_SERVER_notification_context_create (srv, 1);
   /* Connect to core service and register core handlers */
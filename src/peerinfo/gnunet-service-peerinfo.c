@@ -45,6 +45,76 @@
  */
 #define DATA_HOST_CLEAN_FREQ GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 60)
 
+/**
+ * How long do we delay writing updated HELLOs to the HELLO log?
+ * Updates to the same peer within this period are coalesced into
+ * a single record.
+ */
+#define HOSTLOG_FLUSH_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * Minimum size of the HELLO log before we consider compacting it.
+ */
+#define HOSTLOG_MIN_COMPACT_SIZE (1024 * 1024)
+
+/**
+ * Magic number at the beginning of the HELLO log ("PILG").
+ */
+#define HOSTLOG_MAGIC 0x50494c47
+
+/**
+ * Version of the HELLO log format.
+ */
+#define HOSTLOG_VERSION 1
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header at the beginning of the HELLO log.
+ */
+struct HostLogHeader
+{
+  /**
+   * Always #HOSTLOG_MAGIC, in NBO.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Always #HOSTLOG_VERSION, in NBO.
+   */
+  uint32_t version GNUNET_PACKED;
+};
+
+
+/**
+ * Record in the HELLO log.  Followed by @e hello_size bytes of
+ * HELLOs (public and/or friend-only, in the same format as the
+ * files in the hosts directory) and padding to a multiple of 8
+ * bytes.  Only the last record of a peer is valid; a record with
+ * @e hello_size of zero means that the peer has no (unexpired)
+ * addresses left.
+ */
+struct HostLogRecord
+{
+  /**
+   * Total size of the record including this header and padding, in NBO.
+   */
+  uint32_t record_size GNUNET_PACKED;
+
+  /**
+   * Number of bytes of HELLOs following this header, in NBO.
+   */
+  uint32_t hello_size GNUNET_PACKED;
+
+  /**
+   * Identity of the peer.
+   */
+  struct GNUNET_PeerIdentity peer;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
 
 /**
  * In-memory cache of known hosts.
@@ -67,6 +137,33 @@ struct HostEntry
    */
   struct GNUNET_HELLO_Message *friend_only_hello;
 
+  /**
+   * Kept in a DLL of entries waiting to be written to the HELLO log.
+   */
+  struct HostEntry *next;
+
+  /**
+   * Kept in a DLL of entries waiting to be written to the HELLO log.
+   */
+  struct HostEntry *prev;
+
+  /**
+   * Size of the current (valid) record of this peer in the HELLO
+   * log, 0 if there is none.
+   */
+  uint32_t log_size;
+
+  /**
+   * #GNUNET_YES if this entry is in the DLL of dirty entries.
+   */
+  int dirty;
+
+  /**
+   * Version of the entry, incremented whenever one of the HELLOs
+   * changes.  Passed to clients in notifications.
+   */
+  uint32_t version;
+
 };
 
 /**
@@ -127,6 +224,18 @@ struct NotificationContext
    * Interested in friend only HELLO?
    */
   int include_friend_only;
+
+  /**
+   * Filter options of the client, an
+   * `enum GNUNET_PEERINFO_NotifyOptions`.
+   */
+  uint32_t options;
+
+  /**
+   * Only notify about addresses of this transport plugin, NULL
+   * for all addresses.
+   */
+  char *plugin;
 };
 
 
@@ -146,6 +255,46 @@ static struct GNUNET_SERVER_NotificationContext *notify_list;
  */
 static char *networkIdDirectory;
 
+/**
+ * Name of the HELLO log, NULL if we use the hosts directory.
+ */
+static char *hostlog_fn;
+
+/**
+ * Handle of the HELLO log, opened for appending.
+ */
+static struct GNUNET_DISK_FileHandle *hostlog;
+
+/**
+ * Current size of the HELLO log.
+ */
+static uint64_t hostlog_size;
+
+/**
+ * Number of bytes in the HELLO log that belong to valid records.
+ */
+static uint64_t hostlog_live;
+
+/**
+ * Head of DLL of entries that need to be written to the HELLO log.
+ */
+static struct HostEntry *dirty_head;
+
+/**
+ * Tail of DLL of entries that need to be written to the HELLO log.
+ */
+static struct HostEntry *dirty_tail;
+
+/**
+ * Task that writes the dirty entries to the HELLO log.
+ */
+static struct GNUNET_SCHEDULER_Task *hostlog_flush_task;
+
+/**
+ * #GNUNET_YES while we are loading the HELLO log.
+ */
+static int hostlog_loading;
+
 /**
  * Handle for reporting statistics.
  */
@@ -161,6 +310,17 @@ static struct NotificationContext *nc_head;
  */
 static struct NotificationContext *nc_tail;
 
+/**
+ * Number of clients in the notification DLL that use filters or
+ * want only the changed addresses.
+ */
+static unsigned int filtered_clients;
+
+/**
+ * Number of clients in the notification DLL.
+ */
+static unsigned int notify_clients;
+
 
 /**
  * Notify all clients in the notify list about the
@@ -260,26 +420,251 @@ get_host_filename (const struct GNUNET_PeerIdentity *id)
 }
 
 
+/**
+ * Closure for #find_address().
+ */
+struct FindAddressContext
+{
+  /**
+   * Address to look for.
+   */
+  const struct GNUNET_HELLO_Address *address;
+
+  /**
+   * Set to the expiration of the address, if found.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Set to #GNUNET_YES if the address was found.
+   */
+  int found;
+};
+
+
+/**
+ * Address iterator that looks for a particular address.
+ *
+ * @param cls the `struct FindAddressContext`
+ * @param address the address
+ * @param expiration expiration time for the address
+ * @return #GNUNET_SYSERR to stop if the address was found,
+ *         #GNUNET_OK otherwise
+ */
+static int
+find_address (void *cls,
+              const struct GNUNET_HELLO_Address *address,
+              struct GNUNET_TIME_Absolute expiration)
+{
+  struct FindAddressContext *fac = cls;
+
+  if (0 != GNUNET_HELLO_address_cmp (address, fac->address))
+    return GNUNET_OK;
+  fac->found = GNUNET_YES;
+  fac->expiration = expiration;
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Closure for #filter_address().
+ */
+struct FilterAddressContext
+{
+  /**
+   * The HELLO the client was told about before, NULL to not
+   * filter by changes.
+   */
+  const struct GNUNET_HELLO_Message *old_hello;
+
+  /**
+   * Transport plugin to filter for, NULL for all.
+   */
+  const char *plugin;
+
+  /**
+   * Number of addresses that passed the filter.
+   */
+  unsigned int count;
+};
+
+
+/**
+ * Address iterator that removes addresses a client is not
+ * interested in: those of other transport plugins and (if an old
+ * HELLO is given) those that did not change.
+ *
+ * @param cls the `struct FilterAddressContext`
+ * @param address the address
+ * @param expiration expiration time for the address
+ * @return #GNUNET_NO to remove the address, #GNUNET_OK to keep it
+ */
+static int
+filter_address (void *cls,
+                const struct GNUNET_HELLO_Address *address,
+                struct GNUNET_TIME_Absolute expiration)
+{
+  struct FilterAddressContext *fic = cls;
+  struct FindAddressContext fac;
+
+  if ( (NULL != fic->plugin) &&
+       (0 != strcmp (fic->plugin,
+                     address->transport_name)) )
+    return GNUNET_NO;
+  if (NULL != fic->old_hello)
+  {
+    fac.address = address;
+    fac.found = GNUNET_NO;
+    (void) GNUNET_HELLO_iterate_addresses (fic->old_hello,
+                                           GNUNET_NO,
+                                           &find_address,
+                                           &fac);
+    if ( (GNUNET_YES == fac.found) &&
+         (fac.expiration.abs_value_us >= expiration.abs_value_us) )
+      return GNUNET_NO;
+  }
+  fic->count++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create the notification for a client that uses filters.
+ *
+ * @param nc the client
+ * @param he entry of the host for which we generate a notification
+ * @param old_hello the HELLO of the kind the client is interested in
+ *        that the client was told about before, only used for clients
+ *        that want the changed addresses only
+ * @param initial #GNUNET_YES if this is the first notification about
+ *        the peer for the client
+ * @return generated notification message, NULL if there is nothing
+ *         the client is interested in
+ */
+static struct InfoMessage *
+make_filtered_info_message (const struct NotificationContext *nc,
+                            const struct HostEntry *he,
+                            const struct GNUNET_HELLO_Message *old_hello,
+                            int initial)
+{
+  struct FilterAddressContext fic;
+  struct GNUNET_HELLO_Message *filtered;
+  const struct GNUNET_HELLO_Message *src;
+  struct InfoMessage *im;
+  size_t hs;
+
+  src = (GNUNET_YES == nc->include_friend_only)
+    ? he->friend_only_hello
+    : he->hello;
+  if ( (GNUNET_YES != initial) &&
+       (0 != (nc->options & GNUNET_PEERINFO_NOTIFY_OPTION_DELTA)) &&
+       (src == old_hello) )
+    return NULL; /* this kind of HELLO did not change */
+  filtered = NULL;
+  fic.count = 0;
+  if (NULL != src)
+  {
+    fic.old_hello
+      = ( (GNUNET_YES != initial) &&
+          (0 != (nc->options & GNUNET_PEERINFO_NOTIFY_OPTION_DELTA)) )
+      ? old_hello
+      : NULL;
+    fic.plugin = nc->plugin;
+    filtered = GNUNET_HELLO_iterate_addresses (src,
+                                               GNUNET_YES,
+                                               &filter_address,
+                                               &fic);
+  }
+  if ( (0 == fic.count) &&
+       ( (0 != (nc->options & GNUNET_PEERINFO_NOTIFY_OPTION_HAS_ADDRESSES)) ||
+         ( (GNUNET_YES != initial) &&
+           (0 != (nc->options & GNUNET_PEERINFO_NOTIFY_OPTION_DELTA)) ) ) )
+  {
+    GNUNET_free_non_null (filtered);
+    return NULL;
+  }
+  hs = (NULL == filtered) ? 0 : GNUNET_HELLO_size (filtered);
+  im = GNUNET_malloc (sizeof (struct InfoMessage) + hs);
+  im->header.size = htons (hs + sizeof (struct InfoMessage));
+  im->header.type = htons (GNUNET_MESSAGE_TYPE_PEERINFO_INFO);
+  im->reserved = htonl (he->version);
+  im->peer = he->identity;
+  if (NULL != filtered)
+    memcpy (&im[1], filtered, hs);
+  GNUNET_free_non_null (filtered);
+  return im;
+}
+
+
+/**
+ * Check if a client uses filters (or wants only the changes) and
+ * thus needs individual notifications.
+ *
+ * @param nc the client
+ * @return #GNUNET_YES if the client needs #make_filtered_info_message()
+ */
+static int
+is_filtered_client (const struct NotificationContext *nc)
+{
+  return ( (0 != (nc->options & ~GNUNET_PEERINFO_NOTIFY_OPTION_FRIEND_ONLY)) ||
+           (NULL != nc->plugin) ) ? GNUNET_YES : GNUNET_NO;
+}
+
+
 /**
  * Broadcast information about the given entry to all
  * clients that care.
  *
  * @param entry entry to broadcast about
+ * @param old_hello public HELLO of the entry before the change
+ *        (identical to the current one if it did not change)
+ * @param old_friend_only_hello friend-only HELLO of the entry
+ *        before the change (identical to the current one if it
+ *        did not change)
  */
 static void
-notify_all (struct HostEntry *entry)
+notify_all (struct HostEntry *entry,
+            const struct GNUNET_HELLO_Message *old_hello,
+            const struct GNUNET_HELLO_Message *old_friend_only_hello)
 {
   struct InfoMessage *msg_pub;
   struct InfoMessage *msg_friend;
+  struct InfoMessage *msg;
   struct NotificationContext *cur;
+  int initial;
 
-  msg_pub = make_info_message (entry, GNUNET_NO);
-  msg_friend = make_info_message (entry, GNUNET_YES);
+  if (NULL == nc_head)
+    return;
+  msg_pub = NULL;
+  msg_friend = NULL;
+  if (filtered_clients < notify_clients)
+  {
+    msg_pub = make_info_message (entry, GNUNET_NO);
+    msg_friend = make_info_message (entry, GNUNET_YES);
+  }
+  initial = (0 == entry->version) ? GNUNET_YES : GNUNET_NO;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Notifying all clients about peer `%s'\n",
 	      GNUNET_i2s(&entry->identity));
   for (cur = nc_head; NULL != cur; cur = cur->next)
   {
+    if (GNUNET_YES == is_filtered_client (cur))
+    {
+      msg = make_filtered_info_message (cur,
+                                        entry,
+                                        (GNUNET_YES == cur->include_friend_only)
+                                        ? old_friend_only_hello
+                                        : old_hello,
+                                        initial);
+      if (NULL == msg)
+        continue;
+      GNUNET_SERVER_notification_context_unicast (notify_list,
+                                                  cur->client,
+                                                  &msg->header,
+                                                  GNUNET_NO);
+      GNUNET_free (msg);
+      continue;
+    }
     if (GNUNET_NO == cur->include_friend_only)
       {
 	GNUNET_SERVER_notification_context_unicast (notify_list,
@@ -295,8 +680,8 @@ notify_all (struct HostEntry *entry)
 						  GNUNET_NO);
     }
   }
-  GNUNET_free (msg_pub);
-  GNUNET_free (msg_friend);
+  GNUNET_free_non_null (msg_pub);
+  GNUNET_free_non_null (msg_friend);
 }
 
 
@@ -312,71 +697,57 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
 
 
 /**
- * Try to read the HELLOs in the given filename and discard expired
- * addresses.  Removes the file if one the HELLO is malformed.  If all
- * addresses are expired, the HELLO is also removed (but the HELLO
- * with the public key is still returned if it was found and valid).
- * The file can contain multiple HELLO messages.
+ * Parse the HELLOs in the given buffer and discard expired
+ * addresses.  The buffer can contain multiple HELLO messages.
  *
- * @param fn name of the file
- * @param unlink_garbage if #GNUNET_YES, try to remove useless files
- * @param r ReadHostFileContext to store the resutl
+ * @param buffer the HELLOs
+ * @param size_total number of bytes in @a buffer
+ * @param source name of the file @a buffer is from, for logging
+ * @param r ReadHostFileContext to store the result
+ * @return #GNUNET_OK on success, #GNUNET_NO if a HELLO without
+ *         any unexpired addresses was found, #GNUNET_SYSERR if
+ *         a HELLO was malformed
  */
-static void
-read_host_file (const char *fn,
-                int unlink_garbage,
-                struct ReadHostFileContext *r)
+static int
+parse_host_buffer (const char *buffer,
+                   size_t size_total,
+                   const char *source,
+                   struct ReadHostFileContext *r)
 {
-  char buffer[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1] GNUNET_ALIGN;
-  unsigned int size_total;
   struct GNUNET_TIME_Absolute now;
   unsigned int left;
   const struct GNUNET_HELLO_Message *hello;
   struct GNUNET_HELLO_Message *hello_clean;
-  unsigned read_pos;
-  int size_hello;
+  size_t read_pos;
+  uint16_t size_hello;
 
   r->friend_only_hello = NULL;
   r->hello = NULL;
-
-  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
-    return;
-  size_total = GNUNET_DISK_fn_read (fn, buffer, sizeof (buffer));
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Read %u bytes from `%s'\n",
-              size_total,
-              fn);
   if (size_total < sizeof (struct GNUNET_MessageHeader))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
 		_("Failed to parse HELLO in file `%s': %s\n"),
-		fn, "Fail has invalid size");
-    if ( (GNUNET_YES == unlink_garbage) &&
-	 (0 != UNLINK (fn)) &&
-	 (ENOENT != errno) )
-      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                "unlink",
-                                fn);
-    return;
+		source, "Fail has invalid size");
+    return GNUNET_SYSERR;
   }
 
+  left = 0;
   read_pos = 0;
   while (read_pos < size_total)
   {
     hello = (const struct GNUNET_HELLO_Message *) &buffer[read_pos];
-    size_hello = GNUNET_HELLO_size (hello);
+    if ( (size_total - read_pos < sizeof (struct GNUNET_MessageHeader)) ||
+         (size_total - read_pos <
+          ntohs (((const struct GNUNET_MessageHeader *) hello)->size)) )
+      size_hello = 0;
+    else
+      size_hello = GNUNET_HELLO_size (hello);
     if (0 == size_hello)
       {
 	GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
 		    _("Failed to parse HELLO in file `%s'\n"),
-		    fn);
-	if ((GNUNET_YES == unlink_garbage) &&
-	    (0 != UNLINK (fn)) &&
-	    (ENOENT != errno) )
-	  GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                    "unlink",
-                                    fn);
-	return;
+		    source);
+	return GNUNET_SYSERR;
       }
 
     now = GNUNET_TIME_absolute_get ();
@@ -386,14 +757,8 @@ read_host_file (const char *fn,
     {
       GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                   _("Failed to parse HELLO in file `%s'\n"),
-                  fn);
-      if ((GNUNET_YES == unlink_garbage) &&
-          (0 != UNLINK (fn)) &&
-          (ENOENT != errno) )
-        GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
-                                  "unlink",
-                                  fn);
-      return;
+                  source);
+      return GNUNET_SYSERR;
     }
     left = 0;
     (void) GNUNET_HELLO_iterate_addresses (hello_clean, GNUNET_NO,
@@ -429,8 +794,58 @@ read_host_file (const char *fn,
     }
     read_pos += size_hello;
   }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "Found `%s' and `%s' HELLO message in file\n",
+	      (NULL != r->hello) ? "public" : "NON-public",
+	      (NULL != r->friend_only_hello) ? "friend only" : "NO friend only");
+  return (0 == left) ? GNUNET_NO : GNUNET_OK;
+}
+
+
+/**
+ * Try to read the HELLOs in the given filename and discard expired
+ * addresses.  Removes the file if one the HELLO is malformed.  If all
+ * addresses are expired, the HELLO is also removed (but the HELLO
+ * with the public key is still returned if it was found and valid).
+ * The file can contain multiple HELLO messages.
+ *
+ * @param fn name of the file
+ * @param unlink_garbage if #GNUNET_YES, try to remove useless files
+ * @param r ReadHostFileContext to store the resutl
+ */
+static void
+read_host_file (const char *fn,
+                int unlink_garbage,
+                struct ReadHostFileContext *r)
+{
+  char buffer[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1] GNUNET_ALIGN;
+  ssize_t size_total;
+  int ret;
 
-  if (0 == left)
+  r->friend_only_hello = NULL;
+  r->hello = NULL;
+
+  if (GNUNET_YES != GNUNET_DISK_file_test (fn))
+    return;
+  size_total = GNUNET_DISK_fn_read (fn, buffer, sizeof (buffer));
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Read %d bytes from `%s'\n",
+              (int) size_total,
+              fn);
+  if (size_total < 0)
+    size_total = 0;
+  ret = parse_host_buffer (buffer, size_total, fn, r);
+  if (GNUNET_SYSERR == ret)
+  {
+    if ( (GNUNET_YES == unlink_garbage) &&
+	 (0 != UNLINK (fn)) &&
+	 (ENOENT != errno) )
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                                "unlink",
+                                fn);
+    return;
+  }
+  if (GNUNET_NO == ret)
   {
     /* no addresses left, remove from disk */
     if ( (GNUNET_YES == unlink_garbage) &&
@@ -439,10 +854,6 @@ read_host_file (const char *fn,
                                 "unlink",
                                 fn);
   }
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-	      "Found `%s' and `%s' HELLO message in file\n",
-	      (NULL != r->hello) ? "public" : "NON-public",
-	      (NULL != r->friend_only_hello) ? "friend only" : "NO friend only");
 }
 
 
@@ -474,7 +885,7 @@ add_host_to_known_hosts (const struct GNUNET_PeerIdentity *identity)
                                                       &entry->identity,
                                                       entry,
                                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-    notify_all (entry);
+    notify_all (entry, NULL, NULL);
     fn = get_host_filename (identity);
     if (NULL != fn)
     {
@@ -615,98 +1026,477 @@ hosts_directory_scan_callback (void *cls,
   add_host_to_known_hosts (&id);
   if (NULL != r.hello)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Updating peer `%s' public HELLO \n",
-		GNUNET_i2s (&id));
-    update_hello (&id, r.hello);
-    GNUNET_free (r.hello);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Updating peer `%s' public HELLO \n",
+		GNUNET_i2s (&id));
+    update_hello (&id, r.hello);
+    GNUNET_free (r.hello);
+  }
+  if (NULL != r.friend_only_hello)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Updating peer `%s' friend only HELLO \n",
+		GNUNET_i2s (&id));
+    update_hello (&id, r.friend_only_hello);
+    GNUNET_free (r.friend_only_hello);
+  }
+  dsc->matched++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Call this method periodically to scan data/hosts for new hosts.
+ *
+ * @param cls unused
+ * @param tc scheduler context, aborted if reason is shutdown
+ */
+static void
+cron_scan_directory_data_hosts (void *cls,
+                                const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  static unsigned int retries;
+  struct DirScanContext dsc;
+
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  if (GNUNET_SYSERR == GNUNET_DISK_directory_create (networkIdDirectory))
+  {
+    GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_FREQ,
+						GNUNET_SCHEDULER_PRIORITY_IDLE,
+						&cron_scan_directory_data_hosts, NULL);
+    return;
+  }
+  dsc.matched = 0;
+  dsc.remove_files = GNUNET_YES;
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
+              _("Scanning directory `%s'\n"),
+              networkIdDirectory);
+  GNUNET_DISK_directory_scan (networkIdDirectory,
+                              &hosts_directory_scan_callback, &dsc);
+  if ((0 == dsc.matched) && (0 == (++retries & 31)))
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
+                _("Still no peers found in `%s'!\n"),
+                networkIdDirectory);
+  GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_FREQ,
+					      GNUNET_SCHEDULER_PRIORITY_IDLE,
+					      &cron_scan_directory_data_hosts,
+					      NULL);
+}
+
+
+/**
+ * Update the HELLO of a friend by merging the addresses.
+ *
+ * @param hello original hello
+ * @param friend_hello hello with additional addresses
+ * @return merged HELLO
+ */
+static struct GNUNET_HELLO_Message *
+update_friend_hello (const struct GNUNET_HELLO_Message *hello,
+		     const struct GNUNET_HELLO_Message *friend_hello)
+{
+  struct GNUNET_HELLO_Message * res;
+  struct GNUNET_HELLO_Message * tmp;
+  struct GNUNET_CRYPTO_EddsaPublicKey pk;
+
+  if (NULL != friend_hello)
+  {
+    res = GNUNET_HELLO_merge (hello, friend_hello);
+    GNUNET_assert (GNUNET_YES == GNUNET_HELLO_is_friend_only (res));
+    return res;
+  }
+
+  if (GNUNET_OK !=
+      GNUNET_HELLO_get_key (hello, &pk))
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  tmp = GNUNET_HELLO_create (&pk, NULL, NULL, GNUNET_YES);
+  res = GNUNET_HELLO_merge (hello, tmp);
+  GNUNET_free (tmp);
+  GNUNET_assert (GNUNET_YES == GNUNET_HELLO_is_friend_only (res));
+  return res;
+}
+
+
+/**
+ * Serialize the HELLOs of a host that have addresses, in the
+ * format used for the files in the hosts directory and for the
+ * records of the HELLO log.
+ *
+ * @param host the host
+ * @param[out] buffer set to the serialized HELLOs, NULL if none;
+ *             caller must free
+ * @return number of bytes in @a buffer, 0 if there is nothing to store
+ */
+static unsigned int
+serialize_hellos (const struct HostEntry *host,
+                  char **buffer)
+{
+  unsigned int cnt;
+  unsigned int size;
+  unsigned int pos;
+  int store_hello;
+  int store_friend_hello;
+
+  *buffer = NULL;
+  size = 0;
+  cnt = 0;
+  store_hello = GNUNET_NO;
+  if (NULL != host->hello)
+    (void) GNUNET_HELLO_iterate_addresses (host->hello,
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &cnt);
+  if (cnt > 0)
+  {
+    store_hello = GNUNET_YES;
+    size += GNUNET_HELLO_size (host->hello);
+  }
+  cnt = 0;
+  if (NULL != host->friend_only_hello)
+    (void) GNUNET_HELLO_iterate_addresses (host->friend_only_hello,
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &cnt);
+  store_friend_hello = GNUNET_NO;
+  if (0 < cnt)
+  {
+    store_friend_hello = GNUNET_YES;
+    size += GNUNET_HELLO_size (host->friend_only_hello);
+  }
+  if (0 == size)
+    return 0;
+  *buffer = GNUNET_malloc (size);
+  pos = 0;
+  if (GNUNET_YES == store_hello)
+  {
+    memcpy (*buffer, host->hello,
+            GNUNET_HELLO_size (host->hello));
+    pos += GNUNET_HELLO_size (host->hello);
+  }
+  if (GNUNET_YES == store_friend_hello)
+  {
+    memcpy (&(*buffer)[pos], host->friend_only_hello,
+            GNUNET_HELLO_size (host->friend_only_hello));
+    pos += GNUNET_HELLO_size (host->friend_only_hello);
+  }
+  GNUNET_assert (pos == size);
+  return size;
+}
+
+
+/**
+ * Append the current HELLOs of a host to a HELLO log.
+ *
+ * @param fh handle of the HELLO log, positioned at its end
+ * @param host the host to write
+ * @param force_empty #GNUNET_YES to write a record even if the
+ *        host has no addresses (to invalidate its old record)
+ * @param[out] record_size set to the number of bytes written
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on write errors
+ */
+static int
+hostlog_write_record (struct GNUNET_DISK_FileHandle *fh,
+                      const struct HostEntry *host,
+                      int force_empty,
+                      uint32_t *record_size)
+{
+  struct HostLogRecord *rec;
+  char *buffer;
+  unsigned int size;
+  size_t rs;
+  int ret;
+
+  *record_size = 0;
+  size = serialize_hellos (host, &buffer);
+  if ( (0 == size) &&
+       (GNUNET_YES != force_empty) )
+    return GNUNET_OK;
+  rs = sizeof (struct HostLogRecord) + size;
+  rs = (rs + 7) & ~((size_t) 7);
+  rec = GNUNET_malloc (rs);
+  rec->record_size = htonl ((uint32_t) rs);
+  rec->hello_size = htonl (size);
+  rec->peer = host->identity;
+  if (0 != size)
+    memcpy (&rec[1], buffer, size);
+  GNUNET_free_non_null (buffer);
+  ret = GNUNET_OK;
+  if ((ssize_t) rs != GNUNET_DISK_file_write (fh, rec, rs))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              hostlog_fn);
+    ret = GNUNET_SYSERR;
+  }
+  else
+    *record_size = rs;
+  GNUNET_free (rec);
+  return ret;
+}
+
+
+/**
+ * Write the header of a new HELLO log.
+ *
+ * @param fh handle of the (empty) HELLO log
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on write errors
+ */
+static int
+hostlog_write_header (struct GNUNET_DISK_FileHandle *fh)
+{
+  struct HostLogHeader hdr;
+
+  hdr.magic = htonl (HOSTLOG_MAGIC);
+  hdr.version = htonl (HOSTLOG_VERSION);
+  if (sizeof (hdr) != GNUNET_DISK_file_write (fh, &hdr, sizeof (hdr)))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "write",
+                              hostlog_fn);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Closure for #compact_host_cb().
+ */
+struct CompactContext
+{
+  /**
+   * The new HELLO log.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Number of bytes written so far.
+   */
+  uint64_t size;
+
+  /**
+   * #GNUNET_OK if all writes succeeded so far.
+   */
+  int ret;
+};
+
+
+/**
+ * Write a host to the new HELLO log during compaction.
+ *
+ * @param cls the `struct CompactContext`
+ * @param key identity of the peer
+ * @param value the `struct HostEntry`
+ * @return #GNUNET_YES to continue, #GNUNET_NO on write errors
+ */
+static int
+compact_host_cb (void *cls,
+                 const struct GNUNET_PeerIdentity *key,
+                 void *value)
+{
+  struct CompactContext *cc = cls;
+  struct HostEntry *host = value;
+  uint32_t rs;
+
+  if (GNUNET_OK !=
+      hostlog_write_record (cc->fh, host, GNUNET_NO, &rs))
+  {
+    cc->ret = GNUNET_SYSERR;
+    return GNUNET_NO;
+  }
+  cc->size += rs;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Record the sizes of the new records after a successful compaction.
+ *
+ * @param cls NULL
+ * @param key identity of the peer
+ * @param value the `struct HostEntry`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+compact_update_cb (void *cls,
+                   const struct GNUNET_PeerIdentity *key,
+                   void *value)
+{
+  struct HostEntry *host = value;
+  char *buffer;
+  unsigned int size;
+
+  size = serialize_hellos (host, &buffer);
+  GNUNET_free_non_null (buffer);
+  if (0 == size)
+    host->log_size = 0;
+  else
+    host->log_size = (sizeof (struct HostLogRecord) + size + 7) & ~7;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Rewrite the HELLO log with only the current record of each peer.
+ * All dirty entries must have been flushed before.
+ */
+static void
+hostlog_compact (void)
+{
+  struct CompactContext cc;
+  char *tmp;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              _("Compacting HELLO log `%s' (%llu of %llu bytes in use)\n"),
+              hostlog_fn,
+              (unsigned long long) hostlog_live,
+              (unsigned long long) hostlog_size);
+  GNUNET_asprintf (&tmp, "%s.tmp", hostlog_fn);
+  cc.fh = GNUNET_DISK_file_open (tmp,
+                                 GNUNET_DISK_OPEN_WRITE |
+                                 GNUNET_DISK_OPEN_CREATE |
+                                 GNUNET_DISK_OPEN_TRUNCATE,
+                                 GNUNET_DISK_PERM_USER_READ |
+                                 GNUNET_DISK_PERM_USER_WRITE |
+                                 GNUNET_DISK_PERM_GROUP_READ |
+                                 GNUNET_DISK_PERM_OTHER_READ);
+  if (NULL == cc.fh)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "open", tmp);
+    GNUNET_free (tmp);
+    return;
   }
-  if (NULL != r.friend_only_hello)
+  cc.size = sizeof (struct HostLogHeader);
+  cc.ret = hostlog_write_header (cc.fh);
+  if (GNUNET_OK == cc.ret)
+    GNUNET_CONTAINER_multipeermap_iterate (hostmap,
+                                           &compact_host_cb,
+                                           &cc);
+  if ( (GNUNET_OK == cc.ret) &&
+       (GNUNET_OK != GNUNET_DISK_file_sync (cc.fh)) )
+    cc.ret = GNUNET_SYSERR;
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (cc.fh));
+  if ( (GNUNET_OK != cc.ret) ||
+       (0 != RENAME (tmp, hostlog_fn)) )
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Updating peer `%s' friend only HELLO \n",
-		GNUNET_i2s (&id));
-    update_hello (&id, r.friend_only_hello);
-    GNUNET_free (r.friend_only_hello);
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "rename", tmp);
+    (void) UNLINK (tmp);
+    GNUNET_free (tmp);
+    return;
   }
-  dsc->matched++;
-  return GNUNET_OK;
+  GNUNET_free (tmp);
+  if (NULL != hostlog)
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (hostlog));
+  hostlog = GNUNET_DISK_file_open (hostlog_fn,
+                                   GNUNET_DISK_OPEN_WRITE |
+                                   GNUNET_DISK_OPEN_APPEND,
+                                   GNUNET_DISK_PERM_NONE);
+  if (NULL == hostlog)
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "open", hostlog_fn);
+  GNUNET_CONTAINER_multipeermap_iterate (hostmap,
+                                         &compact_update_cb,
+                                         NULL);
+  hostlog_size = cc.size;
+  hostlog_live = cc.size - sizeof (struct HostLogHeader);
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# HELLO log compactions"),
+                            1,
+                            GNUNET_NO);
 }
 
 
 /**
- * Call this method periodically to scan data/hosts for new hosts.
- *
- * @param cls unused
- * @param tc scheduler context, aborted if reason is shutdown
+ * Append the current HELLOs of all dirty entries to the HELLO
+ * log, sync it once and compact it if most of it is garbage.
  */
 static void
-cron_scan_directory_data_hosts (void *cls,
-                                const struct GNUNET_SCHEDULER_TaskContext *tc)
+hostlog_flush (void)
 {
-  static unsigned int retries;
-  struct DirScanContext dsc;
+  struct HostEntry *host;
+  unsigned int written;
+  uint32_t rs;
 
-  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
-    return;
-  if (GNUNET_SYSERR == GNUNET_DISK_directory_create (networkIdDirectory))
+  written = 0;
+  while (NULL != (host = dirty_head))
   {
-    GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_FREQ,
-						GNUNET_SCHEDULER_PRIORITY_IDLE,
-						&cron_scan_directory_data_hosts, NULL);
-    return;
+    GNUNET_CONTAINER_DLL_remove (dirty_head,
+                                 dirty_tail,
+                                 host);
+    host->dirty = GNUNET_NO;
+    if (NULL == hostlog)
+      continue;
+    if (GNUNET_OK !=
+        hostlog_write_record (hostlog,
+                              host,
+                              (0 != host->log_size) ? GNUNET_YES : GNUNET_NO,
+                              &rs))
+      continue;
+    if (0 == rs)
+      continue;
+    written++;
+    hostlog_size += rs;
+    hostlog_live -= host->log_size;
+    host->log_size = (rs > sizeof (struct HostLogRecord)) ? rs : 0;
+    hostlog_live += host->log_size;
   }
-  dsc.matched = 0;
-  dsc.remove_files = GNUNET_YES;
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO | GNUNET_ERROR_TYPE_BULK,
-              _("Scanning directory `%s'\n"),
-              networkIdDirectory);
-  GNUNET_DISK_directory_scan (networkIdDirectory,
-                              &hosts_directory_scan_callback, &dsc);
-  if ((0 == dsc.matched) && (0 == (++retries & 31)))
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING | GNUNET_ERROR_TYPE_BULK,
-                _("Still no peers found in `%s'!\n"),
-                networkIdDirectory);
-  GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_FREQ,
-					      GNUNET_SCHEDULER_PRIORITY_IDLE,
-					      &cron_scan_directory_data_hosts,
-					      NULL);
+  if (0 == written)
+    return;
+  if (GNUNET_OK != GNUNET_DISK_file_sync (hostlog))
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "fsync",
+                              hostlog_fn);
+  GNUNET_STATISTICS_update (stats,
+                            gettext_noop ("# HELLO log records written"),
+                            written,
+                            GNUNET_NO);
+  if ( (hostlog_size > HOSTLOG_MIN_COMPACT_SIZE) &&
+       (hostlog_size - hostlog_live > hostlog_live) )
+    hostlog_compact ();
 }
 
 
 /**
- * Update the HELLO of a friend by merging the addresses.
+ * Task that writes the dirty entries to the HELLO log.
  *
- * @param hello original hello
- * @param friend_hello hello with additional addresses
- * @return merged HELLO
+ * @param cls NULL
+ * @param tc scheduler context
  */
-static struct GNUNET_HELLO_Message *
-update_friend_hello (const struct GNUNET_HELLO_Message *hello,
-		     const struct GNUNET_HELLO_Message *friend_hello)
+static void
+hostlog_flush_cb (void *cls,
+                  const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct GNUNET_HELLO_Message * res;
-  struct GNUNET_HELLO_Message * tmp;
-  struct GNUNET_CRYPTO_EddsaPublicKey pk;
+  hostlog_flush_task = NULL;
+  hostlog_flush ();
+}
 
-  if (NULL != friend_hello)
-  {
-    res = GNUNET_HELLO_merge (hello, friend_hello);
-    GNUNET_assert (GNUNET_YES == GNUNET_HELLO_is_friend_only (res));
-    return res;
-  }
 
-  if (GNUNET_OK !=
-      GNUNET_HELLO_get_key (hello, &pk))
-  {
-    GNUNET_break (0);
-    return NULL;
-  }
-  tmp = GNUNET_HELLO_create (&pk, NULL, NULL, GNUNET_YES);
-  res = GNUNET_HELLO_merge (hello, tmp);
-  GNUNET_free (tmp);
-  GNUNET_assert (GNUNET_YES == GNUNET_HELLO_is_friend_only (res));
-  return res;
+/**
+ * Remember that the HELLOs of a host changed and need to be
+ * written to the HELLO log.  Writes are delayed by
+ * #HOSTLOG_FLUSH_DELAY so that repeated updates are coalesced.
+ *
+ * @param host the host that changed
+ */
+static void
+hostlog_mark_dirty (struct HostEntry *host)
+{
+  if ( (GNUNET_YES == hostlog_loading) ||
+       (GNUNET_YES == host->dirty) )
+    return;
+  host->dirty = GNUNET_YES;
+  GNUNET_CONTAINER_DLL_insert_tail (dirty_head,
+                                    dirty_tail,
+                                    host);
+  if (NULL == hostlog_flush_task)
+    hostlog_flush_task
+      = GNUNET_SCHEDULER_add_delayed_with_priority (HOSTLOG_FLUSH_DELAY,
+                                                    GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                    &hostlog_flush_cb,
+                                                    NULL);
 }
 
 
@@ -724,13 +1514,11 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
   struct HostEntry *host;
   struct GNUNET_HELLO_Message *mrg;
   struct GNUNET_HELLO_Message **dest;
+  struct GNUNET_HELLO_Message *old_dest;
+  struct GNUNET_HELLO_Message *old_friend;
   struct GNUNET_TIME_Absolute delta;
-  unsigned int cnt;
   unsigned int size;
   int friend_hello_type;
-  int store_hello;
-  int store_friend_hello;
-  int pos;
   char *buffer;
 
   host = GNUNET_CONTAINER_multipeermap_get (hostmap, peer);
@@ -752,6 +1540,8 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
     dest = &host->hello;
   }
 
+  old_dest = (*dest);
+  old_friend = host->friend_only_hello;
   if (NULL == (*dest))
   {
     (*dest) = GNUNET_malloc (GNUNET_HELLO_size (hello));
@@ -771,19 +1561,18 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
       GNUNET_free (mrg);
       return;
     }
-    GNUNET_free ((*dest));
     (*dest) = mrg;
   }
 
   if ( (NULL != (host->hello)) &&
        (GNUNET_NO == friend_hello_type) )
   {
-    /* Update friend only hello */
+    /* Update friend only hello; the old one is kept until
+       we notified the clients about the change */
     mrg = update_friend_hello (host->hello, host->friend_only_hello);
-    if (NULL != host->friend_only_hello)
-      GNUNET_free (host->friend_only_hello);
     host->friend_only_hello = mrg;
   }
+  host->version++;
 
   if (NULL != host->hello)
     GNUNET_assert ((GNUNET_NO ==
@@ -792,39 +1581,17 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
     GNUNET_assert ((GNUNET_YES ==
                     GNUNET_HELLO_is_friend_only (host->friend_only_hello)));
 
-  fn = get_host_filename (peer);
+  fn = NULL;
+  if (NULL != hostlog_fn)
+    hostlog_mark_dirty (host);
+  else
+    fn = get_host_filename (peer);
   if ( (NULL != fn) &&
        (GNUNET_OK ==
         GNUNET_DISK_directory_create_for_file (fn)) )
   {
-    store_hello = GNUNET_NO;
-    size = 0;
-    cnt = 0;
-    if (NULL != host->hello)
-      (void) GNUNET_HELLO_iterate_addresses (host->hello,
-					     GNUNET_NO,
-                                             &count_addresses,
-                                             &cnt);
-    if (cnt > 0)
-    {
-      store_hello = GNUNET_YES;
-      size += GNUNET_HELLO_size (host->hello);
-    }
-    cnt = 0;
-    if (NULL != host->friend_only_hello)
-      (void) GNUNET_HELLO_iterate_addresses (host->friend_only_hello,
-                                             GNUNET_NO,
-					     &count_addresses,
-                                             &cnt);
-    store_friend_hello = GNUNET_NO;
-    if (0 < cnt)
-    {
-      store_friend_hello = GNUNET_YES;
-      size += GNUNET_HELLO_size (host->friend_only_hello);
-    }
-
-    if ( (GNUNET_NO == store_hello) &&
-         (GNUNET_NO == store_friend_hello) )
+    size = serialize_hellos (host, &buffer);
+    if (0 == size)
     {
       /* no valid addresses, don't put HELLO on disk; in fact,
 	 if one exists on disk, remove it */
@@ -832,22 +1599,6 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
     }
     else
     {
-      buffer = GNUNET_malloc (size);
-      pos = 0;
-
-      if (GNUNET_YES == store_hello)
-      {
-	memcpy (buffer, host->hello,
-                GNUNET_HELLO_size (host->hello));
-	pos += GNUNET_HELLO_size (host->hello);
-      }
-      if (GNUNET_YES == store_friend_hello)
-      {
-	memcpy (&buffer[pos], host->friend_only_hello, GNUNET_HELLO_size (host->friend_only_hello));
-	pos += GNUNET_HELLO_size (host->friend_only_hello);
-      }
-      GNUNET_assert (pos == size);
-
       if (GNUNET_SYSERR == GNUNET_DISK_fn_write (fn, buffer, size,
 						 GNUNET_DISK_PERM_USER_READ |
 						 GNUNET_DISK_PERM_USER_WRITE |
@@ -856,15 +1607,295 @@ update_hello (const struct GNUNET_PeerIdentity *peer,
 	GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING, "write", fn);
       else
 	GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                    "Stored %s %s HELLO in %s  with total size %u\n",
-		    (GNUNET_YES == store_friend_hello) ? "friend-only": "",
-		    (GNUNET_YES == store_hello) ? "public": "",
+                    "Stored HELLOs in %s with total size %u\n",
 		    fn, size);
       GNUNET_free (buffer);
     }
   }
   GNUNET_free_non_null (fn);
-  notify_all (host);
+  if (GNUNET_YES == friend_hello_type)
+  {
+    notify_all (host, host->hello, old_dest);
+    GNUNET_free_non_null (old_dest);
+  }
+  else
+  {
+    notify_all (host, old_dest, old_friend);
+    GNUNET_free_non_null (old_dest);
+    if (old_friend != host->friend_only_hello)
+      GNUNET_free_non_null (old_friend);
+  }
+}
+
+
+/**
+ * Load the current record of a peer from the HELLO log.
+ *
+ * @param cls NULL
+ * @param key identity of the peer
+ * @param value the `struct HostLogRecord` in the mapped HELLO log
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+hostlog_load_record (void *cls,
+                     const struct GNUNET_PeerIdentity *key,
+                     void *value)
+{
+  const struct HostLogRecord *rec = value;
+  struct ReadHostFileContext r;
+  struct GNUNET_PeerIdentity id;
+  struct HostEntry *host;
+  uint32_t hs;
+
+  hs = ntohl (rec->hello_size);
+  if (0 == hs)
+    return GNUNET_YES;
+  if (GNUNET_SYSERR ==
+      parse_host_buffer ((const char *) &rec[1], hs, hostlog_fn, &r))
+  {
+    GNUNET_free_non_null (r.hello);
+    GNUNET_free_non_null (r.friend_only_hello);
+    return GNUNET_YES;
+  }
+  if ( ( (NULL != r.hello) &&
+         ( (GNUNET_OK != GNUNET_HELLO_get_id (r.hello, &id)) ||
+           (0 != memcmp (&id, key, sizeof (id))) ) ) ||
+       ( (NULL != r.friend_only_hello) &&
+         ( (GNUNET_OK != GNUNET_HELLO_get_id (r.friend_only_hello, &id)) ||
+           (0 != memcmp (&id, key, sizeof (id))) ) ) )
+  {
+    /* HELLOs are not for this peer */
+    GNUNET_break (0);
+    GNUNET_free_non_null (r.hello);
+    GNUNET_free_non_null (r.friend_only_hello);
+    return GNUNET_YES;
+  }
+  if ( (NULL == r.hello) &&
+       (NULL == r.friend_only_hello) )
+    return GNUNET_YES;
+  host = add_host_to_known_hosts (key);
+  if (NULL != r.hello)
+  {
+    update_hello (key, r.hello);
+    GNUNET_free (r.hello);
+  }
+  if (NULL != r.friend_only_hello)
+  {
+    update_hello (key, r.friend_only_hello);
+    GNUNET_free (r.friend_only_hello);
+  }
+  host->log_size = ntohl (rec->record_size);
+  hostlog_live += host->log_size;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Open the HELLO log and load the current record of each peer
+ * into the #hostmap.  A truncated record at the end of the log
+ * (i.e. from a crash during a write) is discarded by compacting
+ * the log.
+ *
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the log
+ *         cannot be used
+ */
+static int
+hostlog_load (void)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_DISK_MapHandle *mh;
+  struct GNUNET_CONTAINER_MultiPeerMap *latest;
+  const struct HostLogHeader *hdr;
+  const struct HostLogRecord *rec;
+  const char *map;
+  off_t fsize;
+  uint64_t off;
+  uint32_t rs;
+  int need_compact;
+
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (hostlog_fn))
+    return GNUNET_SYSERR;
+  fh = GNUNET_DISK_file_open (hostlog_fn,
+                              GNUNET_DISK_OPEN_READ |
+                              GNUNET_DISK_OPEN_CREATE,
+                              GNUNET_DISK_PERM_USER_READ |
+                              GNUNET_DISK_PERM_USER_WRITE |
+                              GNUNET_DISK_PERM_GROUP_READ |
+                              GNUNET_DISK_PERM_OTHER_READ);
+  if (NULL == fh)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "open", hostlog_fn);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != GNUNET_DISK_file_handle_size (fh, &fsize))
+    fsize = 0;
+  need_compact = GNUNET_NO;
+  hostlog_size = sizeof (struct HostLogHeader);
+  hostlog_live = 0;
+  if (0 != fsize)
+  {
+    map = GNUNET_DISK_file_map (fh, &mh, GNUNET_DISK_MAP_TYPE_READ, fsize);
+    if (NULL == map)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "mmap", hostlog_fn);
+      GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+      return GNUNET_SYSERR;
+    }
+    hdr = (const struct HostLogHeader *) map;
+    if ( (fsize < (off_t) sizeof (struct HostLogHeader)) ||
+         (HOSTLOG_MAGIC != ntohl (hdr->magic)) ||
+         (HOSTLOG_VERSION != ntohl (hdr->version)) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  _("HELLO log `%s' has invalid format, ignoring it\n"),
+                  hostlog_fn);
+      need_compact = GNUNET_YES;
+      off = fsize;
+    }
+    else
+    {
+      /* index the last record of each peer */
+      latest = GNUNET_CONTAINER_multipeermap_create (1024, GNUNET_NO);
+      off = sizeof (struct HostLogHeader);
+      while (fsize - off >= sizeof (struct HostLogRecord))
+      {
+        rec = (const struct HostLogRecord *) &map[off];
+        rs = ntohl (rec->record_size);
+        if ( (rs < sizeof (struct HostLogRecord) + ntohl (rec->hello_size)) ||
+             (0 != (rs & 7)) ||
+             (rs > fsize - off) )
+          break;
+        (void) GNUNET_CONTAINER_multipeermap_put (latest,
+                                                  &rec->peer,
+                                                  (void *) rec,
+                                                  GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
+        off += rs;
+      }
+      if (off != (uint64_t) fsize)
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                    _("Discarding %llu bytes of truncated data at the end of HELLO log `%s'\n"),
+                    (unsigned long long) (fsize - off),
+                    hostlog_fn);
+        need_compact = GNUNET_YES;
+      }
+      hostlog_loading = GNUNET_YES;
+      GNUNET_CONTAINER_multipeermap_iterate (latest,
+                                             &hostlog_load_record,
+                                             NULL);
+      hostlog_loading = GNUNET_NO;
+      GNUNET_CONTAINER_multipeermap_destroy (latest);
+    }
+    hostlog_size = off;
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (mh));
+  }
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fh));
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              _("Loaded %u peers from HELLO log `%s'\n"),
+              GNUNET_CONTAINER_multipeermap_size (hostmap),
+              hostlog_fn);
+  if ( (GNUNET_YES == need_compact) ||
+       (0 == fsize) ||
+       ( (hostlog_size > HOSTLOG_MIN_COMPACT_SIZE) &&
+         (hostlog_size - hostlog_live > hostlog_live) ) )
+  {
+    hostlog_compact ();
+    return (NULL == hostlog) ? GNUNET_SYSERR : GNUNET_OK;
+  }
+  hostlog = GNUNET_DISK_file_open (hostlog_fn,
+                                   GNUNET_DISK_OPEN_WRITE |
+                                   GNUNET_DISK_OPEN_APPEND,
+                                   GNUNET_DISK_PERM_NONE);
+  if (NULL == hostlog)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "open", hostlog_fn);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Remove the expired addresses from the HELLOs of a host and
+ * schedule writing it to the HELLO log if any were removed.
+ *
+ * @param cls pointer to the current time
+ * @param key identity of the peer
+ * @param value the `struct HostEntry`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+discard_expired_in_memory (void *cls,
+                           const struct GNUNET_PeerIdentity *key,
+                           void *value)
+{
+  struct GNUNET_TIME_Absolute *now = cls;
+  struct HostEntry *host = value;
+  struct GNUNET_HELLO_Message **hellos[2];
+  struct GNUNET_HELLO_Message *clean;
+  unsigned int before;
+  unsigned int after;
+  unsigned int i;
+
+  hellos[0] = &host->hello;
+  hellos[1] = &host->friend_only_hello;
+  for (i = 0; i < 2; i++)
+  {
+    if (NULL == *hellos[i])
+      continue;
+    before = 0;
+    (void) GNUNET_HELLO_iterate_addresses (*hellos[i],
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &before);
+    clean = GNUNET_HELLO_iterate_addresses (*hellos[i],
+                                            GNUNET_YES,
+                                            &discard_expired,
+                                            now);
+    if (NULL == clean)
+      continue;
+    after = 0;
+    (void) GNUNET_HELLO_iterate_addresses (clean,
+                                           GNUNET_NO,
+                                           &count_addresses,
+                                           &after);
+    if (after == before)
+    {
+      GNUNET_free (clean);
+      continue;
+    }
+    GNUNET_free (*hellos[i]);
+    *hellos[i] = clean;
+    hostlog_mark_dirty (host);
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Call this method periodically to expire ancient addresses when
+ * using the HELLO log.  Works on the in-memory #hostmap only; the
+ * changes are written to the log by the write-behind task.
+ *
+ * @param cls unused
+ * @param tc scheduler context, aborted if reason is shutdown
+ */
+static void
+cron_clean_hostlog (void *cls,
+                    const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_TIME_Absolute now;
+
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  now = GNUNET_TIME_absolute_get ();
+  GNUNET_CONTAINER_multipeermap_iterate (hostmap,
+                                         &discard_expired_in_memory,
+                                         &now);
+  GNUNET_SCHEDULER_add_delayed (DATA_HOST_CLEAN_FREQ,
+                                &cron_clean_hostlog,
+                                NULL);
 }
 
 
@@ -1170,7 +2201,12 @@ do_notify_entry (void *cls,
     return GNUNET_YES;
   }
 
-  msg = make_info_message (he, nc->include_friend_only);
+  if (GNUNET_YES == is_filtered_client (nc))
+    msg = make_filtered_info_message (nc, he, NULL, GNUNET_YES);
+  else
+    msg = make_info_message (he, nc->include_friend_only);
+  if (NULL == msg)
+    return GNUNET_YES;
   GNUNET_SERVER_notification_context_unicast (notify_list,
 					      nc->client,
 					      &msg->header,
@@ -1203,6 +2239,7 @@ handle_notify (void *cls,
   nc->include_friend_only = ntohl (nm->include_friend_only);
 
   GNUNET_CONTAINER_DLL_insert (nc_head, nc_tail, nc);
+  notify_clients++;
   GNUNET_SERVER_client_mark_monitor (client);
 	GNUNET_SERVER_notification_context_add (notify_list, client);
   GNUNET_CONTAINER_multipeermap_iterate (hostmap, &do_notify_entry, nc);
@@ -1210,6 +2247,69 @@ handle_notify (void *cls,
 }
 
 
+/**
+ * Handle NOTIFY_FILTERED-message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+handle_notify_filtered (void *cls,
+                        struct GNUNET_SERVER_Client *client,
+                        const struct GNUNET_MessageHeader *message)
+{
+  const struct NotifyFilteredMessage *nm;
+  struct NotificationContext *nc;
+  const char *plugin;
+  uint16_t size;
+  uint32_t options;
+
+  size = ntohs (message->size);
+  if (size < sizeof (struct NotifyFilteredMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  nm = (const struct NotifyFilteredMessage *) message;
+  plugin = NULL;
+  if (size > sizeof (struct NotifyFilteredMessage))
+  {
+    plugin = (const char *) &nm[1];
+    if ('\0' != plugin[size - sizeof (struct NotifyFilteredMessage) - 1])
+    {
+      GNUNET_break (0);
+      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+      return;
+    }
+  }
+  options = ntohl (nm->options);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+	      "`%s' message received (options %u, plugin `%s')\n",
+	      "NOTIFY_FILTERED",
+              (unsigned int) options,
+              (NULL != plugin) ? plugin : "*");
+  nc = GNUNET_new (struct NotificationContext);
+  nc->client = client;
+  nc->options = options;
+  nc->include_friend_only
+    = (0 != (options & GNUNET_PEERINFO_NOTIFY_OPTION_FRIEND_ONLY))
+    ? GNUNET_YES
+    : GNUNET_NO;
+  if (NULL != plugin)
+    nc->plugin = GNUNET_strdup (plugin);
+  GNUNET_CONTAINER_DLL_insert (nc_head, nc_tail, nc);
+  notify_clients++;
+  if (GNUNET_YES == is_filtered_client (nc))
+    filtered_clients++;
+  GNUNET_SERVER_client_mark_monitor (client);
+  GNUNET_SERVER_notification_context_add (notify_list, client);
+  GNUNET_CONTAINER_multipeermap_iterate (hostmap, &do_notify_entry, nc);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
 /**
  * Client disconnect callback
  *
@@ -1228,6 +2328,10 @@ disconnect_cb (void *cls,
   if (NULL == cur)
     return;
   GNUNET_CONTAINER_DLL_remove (nc_head, nc_tail, cur);
+  notify_clients--;
+  if (GNUNET_YES == is_filtered_client (cur))
+    filtered_clients--;
+  GNUNET_free_non_null (cur->plugin);
   GNUNET_free (cur);
 }
 
@@ -1274,8 +2378,22 @@ shutdown_task (void *cls,
   {
     next = cur->next;
     GNUNET_CONTAINER_DLL_remove (nc_head, nc_tail, cur);
+    GNUNET_free_non_null (cur->plugin);
     GNUNET_free (cur);
   }
+  notify_clients = 0;
+  filtered_clients = 0;
+  if (NULL != hostlog_flush_task)
+  {
+    GNUNET_SCHEDULER_cancel (hostlog_flush_task);
+    hostlog_flush_task = NULL;
+  }
+  hostlog_flush ();
+  if (NULL != hostlog)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (hostlog));
+    hostlog = NULL;
+  }
   GNUNET_CONTAINER_multipeermap_iterate (hostmap,
                                          &free_host_entry,
                                          NULL);
@@ -1308,6 +2426,8 @@ run (void *cls,
      sizeof (struct ListAllPeersMessage)},
     {&handle_notify, NULL, GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY,
      sizeof (struct NotifyMessage)},
+    {&handle_notify_filtered, NULL, GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY_FILTERED,
+     0},
     {NULL, NULL, 0, 0}
   };
   char *peerdir;
@@ -1328,7 +2448,23 @@ run (void *cls,
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
                                 &shutdown_task,
                                 NULL);
-  if (GNUNET_YES != noio)
+  if ( (GNUNET_YES != noio) &&
+       (GNUNET_OK ==
+        GNUNET_CONFIGURATION_get_value_filename (cfg, "peerinfo",
+                                                 "HOSTLOG",
+                                                 &hostlog_fn)) )
+  {
+    /* single HELLO log with in-memory index, no directory scans */
+    if (GNUNET_OK != hostlog_load ())
+    {
+      GNUNET_SCHEDULER_shutdown ();
+      return;
+    }
+    GNUNET_SCHEDULER_add_delayed_with_priority (DATA_HOST_CLEAN_FREQ,
+                                                GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                                &cron_clean_hostlog, NULL);
+  }
+  else if (GNUNET_YES != noio)
   {
     GNUNET_assert (GNUNET_OK ==
 		   GNUNET_CONFIGURATION_get_value_filename (cfg, "peerinfo",
@@ -1346,6 +2482,9 @@ run (void *cls,
 
     GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
 					&cron_clean_data_hosts, NULL);
+  }
+  if (GNUNET_YES != noio)
+  {
     if (GNUNET_YES == use_included)
     {
       ip = GNUNET_OS_installation_get_path (GNUNET_OS_IPK_DATADIR);
@@ -1398,6 +2537,7 @@ main (int argc,
                            GNUNET_SERVICE_OPTION_NONE,
                            &run, NULL)) ? 0 : 1;
   GNUNET_free_non_null (networkIdDirectory);
+  GNUNET_free_non_null (hostlog_fn);
   return ret;
 }
 
@@ -97,6 +97,26 @@ struct NotifyMessage
 };
 
 
+/**
+ * Request to be notified about changes with filters.
+ * Optionally followed by the 0-terminated name of the transport
+ * plugin to restrict notifications to.
+ */
+struct NotifyFilteredMessage
+{
+  /**
+   * Type will be #GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY_FILTERED
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Options, an `enum GNUNET_PEERINFO_NotifyOptions` in NBO.
+   */
+  uint32_t options GNUNET_PACKED;
+
+};
+
+
 /**
  * Message used to inform the client about
  * a particular peer; this message is optionally followed
@@ -113,7 +133,9 @@ struct InfoMessage
   struct GNUNET_MessageHeader header;
 
   /**
-   * Always zero.
+   * Version of the information about the peer, in NBO, for clients
+   * that requested notifications with filters; always zero
+   * otherwise.
    */
   uint32_t reserved GNUNET_PACKED;
 
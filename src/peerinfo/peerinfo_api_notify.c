@@ -68,11 +68,27 @@ struct GNUNET_PEERINFO_NotifyContext
    */
   struct GNUNET_SCHEDULER_Task * task;
 
+  /**
+   * Function to call with information if we use filters,
+   * NULL for unfiltered notifications.
+   */
+  GNUNET_PEERINFO_FilteredProcessor filtered_callback;
+
+  /**
+   * Transport plugin to filter for, NULL for all.
+   */
+  char *plugin;
+
   /**
    * Include friend only HELLOs in callbacks
    */
 
   int include_friend_only;
+
+  /**
+   * Filter options, only used with @e filtered_callback.
+   */
+  enum GNUNET_PEERINFO_NotifyOptions options;
 };
 
 
@@ -169,7 +185,11 @@ process_notification (void *cls, const struct GNUNET_MessageHeader *msg)
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Received information about peer `%s' from peerinfo database\n",
        GNUNET_i2s (&im->peer));
-  nc->callback (nc->callback_cls, &im->peer, hello, NULL);
+  if (NULL != nc->filtered_callback)
+    nc->filtered_callback (nc->callback_cls, &im->peer,
+                           ntohl (im->reserved), hello);
+  else
+    nc->callback (nc->callback_cls, &im->peer, hello, NULL);
   receive_notifications (nc);
 }
 
@@ -201,6 +221,8 @@ transmit_notify_request (void *cls, size_t size, void *buf)
 {
   struct GNUNET_PEERINFO_NotifyContext *nc = cls;
   struct NotifyMessage nm;
+  struct NotifyFilteredMessage nfm;
+  size_t plen;
 
   nc->init = NULL;
   if (buf == NULL)
@@ -210,6 +232,21 @@ transmit_notify_request (void *cls, size_t size, void *buf)
     request_notifications (nc);
     return 0;
   }
+  if (NULL != nc->filtered_callback)
+  {
+    plen = (NULL == nc->plugin) ? 0 : strlen (nc->plugin) + 1;
+    GNUNET_assert (size >= sizeof (struct NotifyFilteredMessage) + plen);
+    nfm.header.type = htons (GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY_FILTERED);
+    nfm.header.size = htons (sizeof (struct NotifyFilteredMessage) + plen);
+    nfm.options = htonl ((uint32_t) nc->options);
+    memcpy (buf, &nfm, sizeof (struct NotifyFilteredMessage));
+    if (0 != plen)
+      memcpy (&((char *) buf)[sizeof (struct NotifyFilteredMessage)],
+              nc->plugin,
+              plen);
+    receive_notifications (nc);
+    return sizeof (struct NotifyFilteredMessage) + plen;
+  }
   GNUNET_assert (size >= sizeof (struct NotifyMessage));
   nm.header.type = htons (GNUNET_MESSAGE_TYPE_PEERINFO_NOTIFY);
   nm.header.size = htons (sizeof (struct NotifyMessage));
@@ -229,10 +266,17 @@ transmit_notify_request (void *cls, size_t size, void *buf)
 static void
 request_notifications (struct GNUNET_PEERINFO_NotifyContext *nc)
 {
+  size_t size;
+
   GNUNET_assert (NULL == nc->init);
+  if (NULL != nc->filtered_callback)
+    size = sizeof (struct NotifyFilteredMessage) +
+      ((NULL == nc->plugin) ? 0 : strlen (nc->plugin) + 1);
+  else
+    size = sizeof (struct NotifyMessage);
   nc->init =
       GNUNET_CLIENT_notify_transmit_ready (nc->client,
-                                           sizeof (struct NotifyMessage),
+                                           size,
                                            GNUNET_TIME_UNIT_FOREVER_REL,
                                            GNUNET_YES, &transmit_notify_request,
                                            nc);
@@ -280,6 +324,62 @@ GNUNET_PEERINFO_notify (const struct GNUNET_CONFIGURATION_Handle *cfg,
 }
 
 
+/**
+ * Call a method whenever our known information about peers
+ * changes, restricted by filters.  Initially calls the given
+ * function for all known peers that pass the filters and then only
+ * signals changes.  With #GNUNET_PEERINFO_NOTIFY_OPTION_DELTA, the
+ * HELLOs passed for changes only contain the changed addresses.
+ *
+ * @param cfg configuration to use
+ * @param options filters to apply
+ * @param plugin only include addresses of this transport plugin,
+ *        NULL for all
+ * @param callback the method to call for each peer
+ * @param callback_cls closure for @a callback
+ * @return NULL on error
+ */
+struct GNUNET_PEERINFO_NotifyContext *
+GNUNET_PEERINFO_notify_filtered (const struct GNUNET_CONFIGURATION_Handle *cfg,
+                                 enum GNUNET_PEERINFO_NotifyOptions options,
+                                 const char *plugin,
+                                 GNUNET_PEERINFO_FilteredProcessor callback,
+                                 void *callback_cls)
+{
+  struct GNUNET_PEERINFO_NotifyContext *nc;
+  struct GNUNET_CLIENT_Connection *client;
+
+  if ( (NULL != plugin) &&
+       (strlen (plugin) + 1 + sizeof (struct NotifyFilteredMessage) >=
+        GNUNET_SERVER_MAX_MESSAGE_SIZE) )
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  client = GNUNET_CLIENT_connect ("peerinfo", cfg);
+  if (client == NULL)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING, _("Could not connect to `%s' service.\n"),
+         "peerinfo");
+    return NULL;
+  }
+  nc = GNUNET_new (struct GNUNET_PEERINFO_NotifyContext);
+  nc->cfg = cfg;
+  nc->client = client;
+  nc->filtered_callback = callback;
+  nc->callback_cls = callback_cls;
+  nc->options = options;
+  nc->include_friend_only
+    = (0 != (options & GNUNET_PEERINFO_NOTIFY_OPTION_FRIEND_ONLY))
+    ? GNUNET_YES
+    : GNUNET_NO;
+  if (NULL != plugin)
+    nc->plugin = GNUNET_strdup (plugin);
+  request_notifications (nc);
+  return nc;
+}
+
+
 /**
  * Stop notifying about changes.
  *
@@ -297,6 +397,7 @@ GNUNET_PEERINFO_notify_cancel (struct GNUNET_PEERINFO_NotifyContext *nc)
     GNUNET_CLIENT_disconnect (nc->client);
   if (NULL != nc->task)
     GNUNET_SCHEDULER_cancel (nc->task);
+  GNUNET_free_non_null (nc->plugin);
   GNUNET_free (nc);
 }
 
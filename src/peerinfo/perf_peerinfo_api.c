@@ -32,7 +32,7 @@
 #include "gnunet_testing_lib.h"
 #include "gnunet_peerinfo_service.h"
 #include "peerinfo.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 
 #define START_SERVICE 1
 
@@ -130,15 +130,28 @@ run (void *cls,
 int
 main (int argc, char *argv[])
 {
+  struct GNUNET_BENCHMARK_Suite *suite;
+  struct GNUNET_TIME_Absolute start;
+
+  suite = GNUNET_BENCHMARK_suite_create ("PEERINFO",
+                                         "perf_peerinfo_api");
+  start = GNUNET_TIME_absolute_get ();
   if (0 != GNUNET_TESTING_service_run ("perf-gnunet-peerinfo",
 				       "peerinfo",
 				       "test_peerinfo_api_data.conf",
 				       &run, NULL))
+  {
+    GNUNET_BENCHMARK_suite_destroy (suite);
     return 1;
+  }
   FPRINTF (stderr, "Received %u/%u calls before timeout\n", numpeers,
 	   NUM_REQUESTS * NUM_REQUESTS / 2);
-  GAUGER ("PEERINFO", "Peerinfo lookups", numpeers / 30, "peers/s");
-  return 0;
+  GNUNET_BENCHMARK_report (suite,
+                           "Peerinfo lookups",
+                           "peers",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           numpeers);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_peerinfo_api.c */
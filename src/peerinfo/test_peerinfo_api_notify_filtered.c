@@ -0,0 +1,244 @@
+/*
+ This file is part of GNUnet.
+ Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+ GNUnet is free software; you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published
+ by the Free Software Foundation; either version 3, or (at your
+ option) any later version.
+
+ GNUnet is distributed in the hope that it will be useful, but
+ WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with GNUnet; see the file COPYING.  If not, write to the
+ Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+ Boston, MA 02110-1301, USA.
+ */
+
+/**
+ * @file peerinfo/test_peerinfo_api_notify_filtered.c
+ * @brief testcase for filtered notifications with only the changed addresses
+ */
+#include "platform.h"
+#include "gnunet_hello_lib.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_peerinfo_service.h"
+#include "gnunet_testing_lib.h"
+#include "peerinfo.h"
+
+#define TIMEOUT  GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+static struct GNUNET_PEERINFO_Handle *h;
+static struct GNUNET_PEERINFO_NotifyContext *pnc_delta;
+static struct GNUNET_PEERINFO_NotifyContext *pnc_other;
+
+static int global_ret;
+
+/**
+ * Number of delta notifications received for our peer.
+ */
+static unsigned int deltas;
+
+/**
+ * Did we get a notification for the subscription filtering for
+ * another plugin (not expected)?
+ */
+static int res_cb_other;
+
+/**
+ * Expiration of all addresses, so that adding the same address
+ * again is not a change.
+ */
+static struct GNUNET_TIME_Absolute expiration;
+
+static struct GNUNET_PeerIdentity pid;
+
+static struct GNUNET_SCHEDULER_Task *timeout_task;
+
+
+static void
+end_badly (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  timeout_task = NULL;
+  GNUNET_break (0);
+  if (NULL != pnc_delta)
+  {
+    GNUNET_PEERINFO_notify_cancel (pnc_delta);
+    pnc_delta = NULL;
+  }
+  if (NULL != pnc_other)
+  {
+    GNUNET_PEERINFO_notify_cancel (pnc_other);
+    pnc_other = NULL;
+  }
+  if (NULL != h)
+  {
+    GNUNET_PEERINFO_disconnect (h);
+    h = NULL;
+  }
+  global_ret = 255;
+}
+
+
+static void
+done (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  if (NULL != pnc_delta)
+    GNUNET_PEERINFO_notify_cancel (pnc_delta);
+  pnc_delta = NULL;
+  if (NULL != pnc_other)
+    GNUNET_PEERINFO_notify_cancel (pnc_other);
+  pnc_other = NULL;
+  GNUNET_PEERINFO_disconnect (h);
+  h = NULL;
+  if (NULL != timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (timeout_task);
+    timeout_task = NULL;
+  }
+  if ( (2 == deltas) && (GNUNET_NO == res_cb_other) )
+    global_ret = 0;
+  else
+    GNUNET_break (0);
+}
+
+
+static ssize_t
+address_generator (void *cls, size_t max, void *buf)
+{
+  size_t *agc = cls;
+  ssize_t ret;
+  struct GNUNET_HELLO_Address address;
+
+  if (0 == *agc)
+    return GNUNET_SYSERR; /* Done */
+  memset (&address.peer, 0, sizeof (struct GNUNET_PeerIdentity));
+  address.address = "Address";
+  address.transport_name = "peerinfotest";
+  address.address_length = *agc;
+  address.local_info = GNUNET_HELLO_ADDRESS_INFO_NONE;
+  ret = GNUNET_HELLO_add_address (&address, expiration, buf, max);
+  (*agc)--;
+  return ret;
+}
+
+
+static void
+add_peer_done (void *cls, const char *emsg)
+{
+  if (NULL == emsg)
+    return;
+  GNUNET_break (0);
+  GNUNET_SCHEDULER_cancel (timeout_task);
+  timeout_task = GNUNET_SCHEDULER_add_now (&end_badly, NULL);
+}
+
+
+static void
+add_peer (size_t agc)
+{
+  struct GNUNET_HELLO_Message *h2;
+
+  h2 = GNUNET_HELLO_create (&pid.public_key, &address_generator, &agc,
+                            GNUNET_NO);
+  GNUNET_PEERINFO_add_peer (h, h2, &add_peer_done, NULL);
+  GNUNET_free (h2);
+}
+
+
+static int
+count_addresses (void *cls,
+                 const struct GNUNET_HELLO_Address *address,
+                 struct GNUNET_TIME_Absolute exp)
+{
+  unsigned int *cnt = cls;
+
+  (*cnt)++;
+  return GNUNET_OK;
+}
+
+
+static void
+process_delta (void *cls,
+               const struct GNUNET_PeerIdentity *peer,
+               uint32_t version,
+               const struct GNUNET_HELLO_Message *hello)
+{
+  unsigned int cnt;
+
+  if (0 != memcmp (&pid, peer, sizeof (pid)))
+    return;
+  cnt = 0;
+  if (NULL != hello)
+    (void) GNUNET_HELLO_iterate_addresses (hello, GNUNET_NO,
+                                           &count_addresses, &cnt);
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Received version %u for peer `%s' with %u addresses\n",
+              (unsigned int) version,
+              GNUNET_i2s (peer),
+              cnt);
+  deltas++;
+  if (1 == deltas)
+  {
+    /* initial HELLO with both addresses */
+    GNUNET_break (2 == cnt);
+    /* one address is known, one is new */
+    add_peer (3);
+    return;
+  }
+  GNUNET_break (1 == cnt);
+  GNUNET_SCHEDULER_add_now (&done, NULL);
+}
+
+
+static void
+process_other (void *cls,
+               const struct GNUNET_PeerIdentity *peer,
+               uint32_t version,
+               const struct GNUNET_HELLO_Message *hello)
+{
+  if (0 != memcmp (&pid, peer, sizeof (pid)))
+    return;
+  GNUNET_break (0);
+  res_cb_other = GNUNET_YES;
+}
+
+
+static void
+run (void *cls, const struct GNUNET_CONFIGURATION_Handle *cfg,
+     struct GNUNET_TESTING_Peer *peer)
+{
+  timeout_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT, &end_badly, NULL);
+  expiration = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_UNIT_HOURS);
+  memset (&pid, 32, sizeof (pid));
+  pnc_delta = GNUNET_PEERINFO_notify_filtered (cfg,
+                                               GNUNET_PEERINFO_NOTIFY_OPTION_HAS_ADDRESSES |
+                                               GNUNET_PEERINFO_NOTIFY_OPTION_DELTA,
+                                               "peerinfotest",
+                                               &process_delta, NULL);
+  pnc_other = GNUNET_PEERINFO_notify_filtered (cfg,
+                                               GNUNET_PEERINFO_NOTIFY_OPTION_HAS_ADDRESSES,
+                                               "other",
+                                               &process_other, NULL);
+  h = GNUNET_PEERINFO_connect (cfg);
+  GNUNET_assert (NULL != h);
+  add_peer (2);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  global_ret = 3;
+  if (0 != GNUNET_TESTING_service_run ("test-peerinfo-api-notify-filtered",
+                                       "peerinfo",
+                                       "test_peerinfo_api_data.conf",
+                                       &run, NULL))
+    return 1;
+  return global_ret;
+}
+
+/* end of test_peerinfo_api_notify_filtered.c */
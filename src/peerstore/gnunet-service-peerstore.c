@@ -50,6 +50,147 @@ struct ClientEntry
   struct GNUNET_SERVER_Client *client;
 };
 
+/**
+ * State of an iterate request from a client
+ */
+struct IterateContext
+{
+  /**
+   * The request, with the client that made it.
+   */
+  struct GNUNET_PEERSTORE_Record *record;
+
+  /**
+   * Number of bytes used in @e buf, including the header.
+   */
+  size_t off;
+
+  /**
+   * Cache entry to fill with the records returned by the database,
+   * NULL if the results are not cached.
+   */
+  struct CacheEntry *fill;
+
+  /**
+   * Records to send in the next batch, prefixed by space
+   * for a `struct GNUNET_MessageHeader`.
+   */
+  char buf[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1];
+};
+
+/**
+ * State of a store request from a client
+ */
+struct StoreContext
+{
+  /**
+   * The record to store, with the client that sent it.
+   */
+  struct GNUNET_PEERSTORE_Record *record;
+
+  /**
+   * How to store the record.
+   */
+  enum GNUNET_PEERSTORE_StoreOption options;
+};
+
+/**
+ * A value stored under a key in the record cache
+ */
+struct CacheValue
+{
+  /**
+   * DLL.
+   */
+  struct CacheValue *next;
+
+  /**
+   * DLL.
+   */
+  struct CacheValue *prev;
+
+  /**
+   * Expiry time of the record.
+   */
+  struct GNUNET_TIME_Absolute expiry;
+
+  /**
+   * Size of the value, which follows this struct.
+   */
+  size_t value_size;
+};
+
+/**
+ * Cached records for a (sub system, peer, key) combination.  The
+ * cache is write-through: the database always has the same records,
+ * the cache only saves going to the database for keys that are used
+ * a lot.
+ */
+struct CacheEntry
+{
+  /**
+   * LRU DLL.
+   */
+  struct CacheEntry *next;
+
+  /**
+   * LRU DLL.
+   */
+  struct CacheEntry *prev;
+
+  /**
+   * Head of the values.
+   */
+  struct CacheValue *value_head;
+
+  /**
+   * Tail of the values.
+   */
+  struct CacheValue *value_tail;
+
+  /**
+   * Hash of sub system, peer and key, key in #cache.
+   */
+  struct GNUNET_HashCode keyhash;
+
+  /**
+   * Sub system.
+   */
+  char *sub_system;
+
+  /**
+   * Record key.
+   */
+  char *key;
+
+  /**
+   * Peer.
+   */
+  struct GNUNET_PeerIdentity peer;
+
+  /**
+   * Number of values in the DLL.
+   */
+  unsigned int num_values;
+
+  /**
+   * #GNUNET_YES if the DLL has all values the database has for
+   * this key, #GNUNET_NO while it is being filled.
+   */
+  int complete;
+};
+
+/**
+ * Maximum number of keys in the record cache.
+ */
+#define CACHE_MAX_ENTRIES 1024
+
+/**
+ * Maximum number of values for a key in the record cache; keys with
+ * more values are only served by the database.
+ */
+#define CACHE_MAX_VALUES 16
+
 /**
  * Interval for expired records cleanup (in seconds)
  */
@@ -95,6 +236,202 @@ static struct ClientEntry *client_tail;
  */
 static int in_shutdown;
 
+/**
+ * Record cache, maps hashes of sub system, peer and key to
+ * `struct CacheEntry`s.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *cache;
+
+/**
+ * Most recently used cache entry.
+ */
+static struct CacheEntry *cache_head;
+
+/**
+ * Least recently used cache entry.
+ */
+static struct CacheEntry *cache_tail;
+
+
+/**
+ * Drop all values of a cache entry.
+ *
+ * @param ce the cache entry
+ */
+static void
+cache_entry_clear (struct CacheEntry *ce)
+{
+  struct CacheValue *cv;
+
+  while (NULL != (cv = ce->value_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (ce->value_head, ce->value_tail, cv);
+    GNUNET_free (cv);
+  }
+  ce->num_values = 0;
+}
+
+
+/**
+ * Remove an entry from the record cache.
+ *
+ * @param ce the cache entry
+ */
+static void
+cache_entry_free (struct CacheEntry *ce)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (cache, &ce->keyhash,
+                                                       ce));
+  GNUNET_CONTAINER_DLL_remove (cache_head, cache_tail, ce);
+  cache_entry_clear (ce);
+  GNUNET_free (ce->sub_system);
+  GNUNET_free (ce->key);
+  GNUNET_free (ce);
+}
+
+
+/**
+ * Find the cache entry for a key and mark it as recently used.
+ *
+ * @param keyhash hash of @a sub_system, @a peer and @a key
+ * @param sub_system sub system
+ * @param peer peer
+ * @param key record key
+ * @return the cache entry, NULL if the key is not cached
+ */
+static struct CacheEntry *
+cache_lookup (const struct GNUNET_HashCode *keyhash, const char *sub_system,
+              const struct GNUNET_PeerIdentity *peer, const char *key)
+{
+  struct CacheEntry *ce;
+
+  ce = GNUNET_CONTAINER_multihashmap_get (cache, keyhash);
+  if (NULL == ce)
+    return NULL;
+  if ( (0 != strcmp (ce->sub_system, sub_system)) ||
+       (0 != memcmp (&ce->peer, peer, sizeof (struct GNUNET_PeerIdentity))) ||
+       (0 != strcmp (ce->key, key)) )
+  {
+    /* hash collision, not our key */
+    cache_entry_free (ce);
+    return NULL;
+  }
+  GNUNET_CONTAINER_DLL_remove (cache_head, cache_tail, ce);
+  GNUNET_CONTAINER_DLL_insert (cache_head, cache_tail, ce);
+  return ce;
+}
+
+
+/**
+ * Create an (empty, incomplete) cache entry for a key, evicting the
+ * least recently used entry if the cache is full.
+ *
+ * @param keyhash hash of @a sub_system, @a peer and @a key
+ * @param sub_system sub system
+ * @param peer peer
+ * @param key record key
+ * @return the new cache entry
+ */
+static struct CacheEntry *
+cache_create (const struct GNUNET_HashCode *keyhash, const char *sub_system,
+              const struct GNUNET_PeerIdentity *peer, const char *key)
+{
+  struct CacheEntry *ce;
+
+  if (GNUNET_CONTAINER_multihashmap_size (cache) >= CACHE_MAX_ENTRIES)
+    cache_entry_free (cache_tail);
+  ce = GNUNET_new (struct CacheEntry);
+  ce->keyhash = *keyhash;
+  ce->sub_system = GNUNET_strdup (sub_system);
+  ce->peer = *peer;
+  ce->key = GNUNET_strdup (key);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (cache, keyhash, ce,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  GNUNET_CONTAINER_DLL_insert (cache_head, cache_tail, ce);
+  return ce;
+}
+
+
+/**
+ * Add a value to a cache entry.  Entries with too many values are
+ * removed from the cache.
+ *
+ * @param ce the cache entry
+ * @param value the value
+ * @param value_size size of @a value
+ * @param expiry expiry time of the value
+ * @return #GNUNET_OK if the value was added,
+ *         #GNUNET_NO if @a ce was removed from the cache
+ */
+static int
+cache_add_value (struct CacheEntry *ce, const void *value, size_t value_size,
+                 struct GNUNET_TIME_Absolute expiry)
+{
+  struct CacheValue *cv;
+
+  if (ce->num_values >= CACHE_MAX_VALUES)
+  {
+    cache_entry_free (ce);
+    return GNUNET_NO;
+  }
+  cv = GNUNET_malloc (sizeof (struct CacheValue) + value_size);
+  cv->expiry = expiry;
+  cv->value_size = value_size;
+  memcpy (&cv[1], value, value_size);
+  GNUNET_CONTAINER_DLL_insert_tail (ce->value_head, ce->value_tail, cv);
+  ce->num_values++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Update the record cache after a record was stored in the database.
+ *
+ * @param keyhash hash of the record's sub system, peer and key
+ * @param record the record
+ * @param options how the record was stored
+ */
+static void
+cache_store (const struct GNUNET_HashCode *keyhash,
+             const struct GNUNET_PEERSTORE_Record *record,
+             enum GNUNET_PEERSTORE_StoreOption options)
+{
+  struct CacheEntry *ce;
+
+  ce = cache_lookup (keyhash, record->sub_system, record->peer, record->key);
+  if (GNUNET_PEERSTORE_STOREOPTION_REPLACE == options)
+  {
+    /* the record is now the only one for this key */
+    if (NULL == ce)
+      ce = cache_create (keyhash, record->sub_system, record->peer,
+                         record->key);
+    else
+      cache_entry_clear (ce);
+    ce->complete = GNUNET_YES;
+  }
+  else if (NULL == ce)
+  {
+    /* we do not know the other values for this key */
+    return;
+  }
+  cache_add_value (ce, record->value, record->value_size, *record->expiry);
+}
+
+
+/**
+ * Destroy the record cache.
+ */
+static void
+cache_destroy ()
+{
+  while (NULL != cache_head)
+    cache_entry_free (cache_head);
+  GNUNET_CONTAINER_multihashmap_destroy (cache);
+  cache = NULL;
+}
+
 /**
  * Perform the actual shutdown operations
  */
@@ -117,6 +454,8 @@ do_shutdown ()
     GNUNET_CONTAINER_multihashmap_destroy (watchers);
     watchers = NULL;
   }
+  if (NULL != cache)
+    cache_destroy ();
   GNUNET_SCHEDULER_shutdown ();
 }
 
@@ -233,9 +572,32 @@ handle_client_disconnect (void *cls, struct GNUNET_SERVER_Client *client)
 
 
 /**
- * Function called by for each matching record.
+ * Send the records collected for an iterate request to the client
+ * as one #GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORDS message.
  *
- * @param cls closure
+ * @param ic the iterate request
+ */
+static void
+flush_iterate_batch (struct IterateContext *ic)
+{
+  struct GNUNET_MessageHeader *hdr;
+
+  if (sizeof (struct GNUNET_MessageHeader) == ic->off)
+    return;
+  hdr = (struct GNUNET_MessageHeader *) ic->buf;
+  hdr->size = htons ((uint16_t) ic->off);
+  hdr->type = htons (GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORDS);
+  GNUNET_SERVER_notification_context_unicast (nc, ic->record->client, hdr,
+                                              GNUNET_NO);
+  ic->off = sizeof (struct GNUNET_MessageHeader);
+}
+
+
+/**
+ * Function called by for each matching record.  Records are
+ * collected and sent to the client in batches.
+ *
+ * @param cls closure, a `struct IterateContext`
  * @param record peerstore record found
  * @param emsg error message or NULL if no errors
  * @return #GNUNET_YES to continue iteration
@@ -244,37 +606,102 @@ static int
 record_iterator (void *cls, const struct GNUNET_PEERSTORE_Record *record,
                  const char *emsg)
 {
-  struct GNUNET_PEERSTORE_Record *cls_record = cls;
+  struct IterateContext *ic = cls;
   struct StoreRecordMessage *srm;
+  uint16_t srm_size;
 
   if (NULL == record)
   {
     /* No more records */
     struct GNUNET_MessageHeader endmsg;
 
+    if (NULL != ic->fill)
+    {
+      if (NULL == emsg)
+        ic->fill->complete = GNUNET_YES;
+      else
+        cache_entry_free (ic->fill);
+    }
+    flush_iterate_batch (ic);
     endmsg.size = htons (sizeof (struct GNUNET_MessageHeader));
     endmsg.type = htons (GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_END);
-    GNUNET_SERVER_notification_context_unicast (nc, cls_record->client, &endmsg,
-                                                GNUNET_NO);
-    GNUNET_SERVER_receive_done (cls_record->client,
+    GNUNET_SERVER_notification_context_unicast (nc, ic->record->client,
+                                                &endmsg, GNUNET_NO);
+    GNUNET_SERVER_receive_done (ic->record->client,
                                 NULL == emsg ? GNUNET_OK : GNUNET_SYSERR);
-    PEERSTORE_destroy_record (cls_record);
+    PEERSTORE_destroy_record (ic->record);
+    GNUNET_free (ic);
     return GNUNET_NO;
   }
 
+  if ( (NULL != ic->fill) &&
+       (GNUNET_OK !=
+        cache_add_value (ic->fill, record->value, record->value_size,
+                         *record->expiry)) )
+    ic->fill = NULL;
   srm =
       PEERSTORE_create_record_message (record->sub_system, record->peer,
                                        record->key, record->value,
                                        record->value_size, record->expiry,
                                        GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORD);
-  GNUNET_SERVER_notification_context_unicast (nc, cls_record->client,
-                                              (struct GNUNET_MessageHeader *)
-                                              srm, GNUNET_NO);
+  srm_size = ntohs (srm->header.size);
+  if (ic->off + srm_size > sizeof (ic->buf))
+    flush_iterate_batch (ic);
+  if (ic->off + srm_size > sizeof (ic->buf))
+  {
+    /* too big for a batch, send on its own */
+    GNUNET_SERVER_notification_context_unicast (nc, ic->record->client,
+                                                &srm->header, GNUNET_NO);
+  }
+  else
+  {
+    memcpy (&ic->buf[ic->off], srm, srm_size);
+    ic->off += srm_size;
+  }
   GNUNET_free (srm);
   return GNUNET_YES;
 }
 
 
+/**
+ * Answer an iterate request from the record cache.
+ *
+ * @param ic the iterate request
+ * @param ce cache entry with all records for the requested key
+ */
+static void
+iterate_cached (struct IterateContext *ic, struct CacheEntry *ce)
+{
+  struct GNUNET_PEERSTORE_Record record;
+  struct GNUNET_TIME_Absolute now;
+  struct CacheValue *cv;
+  struct CacheValue *next;
+
+  now = GNUNET_TIME_absolute_get ();
+  memset (&record, 0, sizeof (record));
+  record.sub_system = ce->sub_system;
+  record.peer = &ce->peer;
+  record.key = ce->key;
+  record.client = ic->record->client;
+  for (cv = ce->value_head; NULL != cv; cv = next)
+  {
+    next = cv->next;
+    if (cv->expiry.abs_value_us < now.abs_value_us)
+    {
+      GNUNET_CONTAINER_DLL_remove (ce->value_head, ce->value_tail, cv);
+      ce->num_values--;
+      GNUNET_free (cv);
+      continue;
+    }
+    record.value = &cv[1];
+    record.value_size = cv->value_size;
+    record.expiry = &cv->expiry;
+    record_iterator (ic, &record, NULL);
+  }
+  record_iterator (ic, NULL, NULL);
+}
+
+
 /**
  * Iterator over all watcher clients
  * to notify them of a new record
@@ -308,15 +735,14 @@ watch_notifier_it (void *cls, const struct GNUNET_HashCode *key, void *value)
 /**
  * Given a new record, notifies watchers
  *
+ * @param keyhash hash of the record's sub system, peer and key
  * @param record changed record to update watchers with
  */
 static void
-watch_notifier (struct GNUNET_PEERSTORE_Record *record)
+watch_notifier (const struct GNUNET_HashCode *keyhash,
+                struct GNUNET_PEERSTORE_Record *record)
 {
-  struct GNUNET_HashCode keyhash;
-
-  PEERSTORE_hash_key (record->sub_system, record->peer, record->key, &keyhash);
-  GNUNET_CONTAINER_multihashmap_get_multiple (watchers, &keyhash,
+  GNUNET_CONTAINER_multihashmap_get_multiple (watchers, keyhash,
                                               &watch_notifier_it, record);
 }
 
@@ -376,6 +802,9 @@ handle_iterate (void *cls, struct GNUNET_SERVER_Client *client,
                 const struct GNUNET_MessageHeader *message)
 {
   struct GNUNET_PEERSTORE_Record *record;
+  struct IterateContext *ic;
+  struct CacheEntry *ce;
+  struct GNUNET_HashCode keyhash;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Received an iterate request.\n");
   record = PEERSTORE_parse_record_message (message);
@@ -400,12 +829,37 @@ handle_iterate (void *cls, struct GNUNET_SERVER_Client *client,
               (NULL == record->key) ? "NULL" : record->key);
   GNUNET_SERVER_notification_context_add (nc, client);
   record->client = client;
+  ic = GNUNET_new (struct IterateContext);
+  ic->record = record;
+  ic->off = sizeof (struct GNUNET_MessageHeader);
+  if ( (NULL != record->peer) && (NULL != record->key) )
+  {
+    /* full key, try the cache */
+    PEERSTORE_hash_key (record->sub_system, record->peer, record->key,
+                        &keyhash);
+    ce = cache_lookup (&keyhash, record->sub_system, record->peer,
+                       record->key);
+    if ( (NULL != ce) && (GNUNET_YES == ce->complete) )
+    {
+      iterate_cached (ic, ce);
+      return;
+    }
+    if (NULL == ce)
+      ce = cache_create (&keyhash, record->sub_system, record->peer,
+                         record->key);
+    else
+      cache_entry_clear (ce);
+    ic->fill = ce;
+  }
   if (GNUNET_OK !=
       db->iterate_records (db->cls, record->sub_system, record->peer,
-                           record->key, &record_iterator, record))
+                           record->key, &record_iterator, ic))
   {
+    if (NULL != ic->fill)
+      cache_entry_free (ic->fill);
     GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     PEERSTORE_destroy_record (record);
+    GNUNET_free (ic);
   }
 }
 
@@ -413,20 +867,26 @@ handle_iterate (void *cls, struct GNUNET_SERVER_Client *client,
 /**
  * Continuation of store_record called by the peerstore plugin
  *
- * @param cls closure
+ * @param cls closure, a `struct StoreContext`
  * @param success result
  */
 static void
 store_record_continuation (void *cls, int success)
 {
-  struct GNUNET_PEERSTORE_Record *record = cls;
+  struct StoreContext *sc = cls;
+  struct GNUNET_PEERSTORE_Record *record = sc->record;
+  struct GNUNET_HashCode keyhash;
 
   GNUNET_SERVER_receive_done (record->client, success);
   if (GNUNET_OK == success)
   {
-    watch_notifier (record);
+    PEERSTORE_hash_key (record->sub_system, record->peer, record->key,
+                        &keyhash);
+    cache_store (&keyhash, record, sc->options);
+    watch_notifier (&keyhash, record);
   }
   PEERSTORE_destroy_record (record);
+  GNUNET_free (sc);
 }
 
 
@@ -443,6 +903,7 @@ handle_store (void *cls, struct GNUNET_SERVER_Client *client,
 {
   struct GNUNET_PEERSTORE_Record *record;
   struct StoreRecordMessage *srm;
+  struct StoreContext *sc;
 
   record = PEERSTORE_parse_record_message (message);
   if (NULL == record)
@@ -468,15 +929,19 @@ handle_store (void *cls, struct GNUNET_SERVER_Client *client,
               GNUNET_i2s (record->peer), record->key, record->value_size,
               ntohl (srm->options));
   record->client = client;
+  sc = GNUNET_new (struct StoreContext);
+  sc->record = record;
+  sc->options = ntohl (srm->options);
   if (GNUNET_OK !=
       db->store_record (db->cls, record->sub_system, record->peer, record->key,
                         record->value, record->value_size, *record->expiry,
-                        ntohl (srm->options), store_record_continuation,
-                        record))
+                        sc->options, store_record_continuation,
+                        sc))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 _("Failed to store requested value, database error."));
     PEERSTORE_destroy_record (record);
+    GNUNET_free (sc);
     GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     return;
   }
@@ -571,6 +1036,7 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   }
   nc = GNUNET_SERVER_notification_context_create (server, 16);
   watchers = GNUNET_CONTAINER_multihashmap_create (10, GNUNET_NO);
+  cache = GNUNET_CONTAINER_multihashmap_create (CACHE_MAX_ENTRIES, GNUNET_NO);
   GNUNET_SCHEDULER_add_now (&cleanup_expired_records, NULL);
   GNUNET_SERVER_add_handlers (server, handlers);
   GNUNET_SERVER_connect_notify (server, &handle_client_connect, NULL);
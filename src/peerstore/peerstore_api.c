@@ -310,6 +310,8 @@ store_request_sent (void *cls)
  */
 static const struct GNUNET_MQ_MessageHandler mq_handlers[] = {
   {&handle_iterate_result, GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORD, 0},
+  {&handle_iterate_result, GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORDS,
+   sizeof (struct GNUNET_MessageHeader)},
   {&handle_iterate_result, GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_END,
    sizeof (struct GNUNET_MessageHeader)},
   {&handle_watch_result, GNUNET_MESSAGE_TYPE_PEERSTORE_WATCH_RECORD, 0},
@@ -654,6 +656,37 @@ GNUNET_PEERSTORE_store (struct GNUNET_PEERSTORE_Handle *h,
 /*******************           ITERATE FUNCTIONS          *********************/
 /******************************************************************************/
 
+/**
+ * Pass a record received in response to an iterate request
+ * to the callback.
+ *
+ * @param ic the iterate request
+ * @param msg the record message
+ */
+static void
+process_iterate_record (struct GNUNET_PEERSTORE_IterateContext *ic,
+                        const struct GNUNET_MessageHeader *msg)
+{
+  struct GNUNET_PEERSTORE_Record *record;
+  int continue_iter;
+
+  if (NULL == ic->callback)
+    return;
+  record = PEERSTORE_parse_record_message (msg);
+  if (NULL == record)
+    continue_iter =
+        ic->callback (ic->callback_cls, NULL,
+                      _("Received a malformed response from service."));
+  else
+  {
+    continue_iter = ic->callback (ic->callback_cls, record, NULL);
+    PEERSTORE_destroy_record (record);
+  }
+  if (GNUNET_NO == continue_iter)
+    ic->callback = NULL;
+}
+
+
 /**
  * When a response for iterate request is received
  *
@@ -668,8 +701,10 @@ handle_iterate_result (void *cls, const struct GNUNET_MessageHeader *msg)
   GNUNET_PEERSTORE_Processor callback;
   void *callback_cls;
   uint16_t msg_type;
-  struct GNUNET_PEERSTORE_Record *record;
-  int continue_iter;
+  const struct GNUNET_MessageHeader *rec;
+  const char *pos;
+  size_t left;
+  uint16_t rsize;
 
   ic = h->iterate_head;
   if (NULL == ic)
@@ -699,21 +734,32 @@ handle_iterate_result (void *cls, const struct GNUNET_MessageHeader *msg)
       callback (callback_cls, NULL, NULL);
     return;
   }
-  if (NULL != callback)
+  if (GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORD == msg_type)
   {
-    record = PEERSTORE_parse_record_message (msg);
-    if (NULL == record)
-      continue_iter =
-          callback (callback_cls, NULL,
-                    _("Received a malformed response from service."));
-    else
-    {
-      continue_iter = callback (callback_cls, record, NULL);
-      PEERSTORE_destroy_record (record);
-    }
-    if (GNUNET_NO == continue_iter)
-      ic->callback = NULL;
+    process_iterate_record (ic, msg);
+    return;
   }
+  /* batch of record messages */
+  pos = (const char *) &msg[1];
+  left = ntohs (msg->size) - sizeof (struct GNUNET_MessageHeader);
+  while (left >= sizeof (struct GNUNET_MessageHeader))
+  {
+    rec = (const struct GNUNET_MessageHeader *) pos;
+    rsize = ntohs (rec->size);
+    if ( (rsize < sizeof (struct GNUNET_MessageHeader)) ||
+         (rsize > left) ||
+         (GNUNET_MESSAGE_TYPE_PEERSTORE_ITERATE_RECORD != ntohs (rec->type)) )
+      break;
+    process_iterate_record (ic, rec);
+    pos += rsize;
+    left -= rsize;
+  }
+  if ( (0 != left) &&
+       (NULL != ic->callback) &&
+       (GNUNET_NO ==
+        ic->callback (ic->callback_cls, NULL,
+                      _("Received a malformed response from service."))) )
+    ic->callback = NULL;
 }
 
 
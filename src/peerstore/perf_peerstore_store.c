@@ -25,6 +25,7 @@
 #include "gnunet_util_lib.h"
 #include "gnunet_testing_lib.h"
 #include "gnunet_peerstore_service.h"
+#include "gnunet_benchmark_lib.h"
 
 #define STORES 10000
 
@@ -91,18 +92,22 @@ run (void *cls, const struct GNUNET_CONFIGURATION_Handle *cfg,
 int
 main (int argc, char *argv[])
 {
+  struct GNUNET_BENCHMARK_Suite *suite;
   struct GNUNET_TIME_Absolute start;
-  struct GNUNET_TIME_Relative diff;
 
+  suite = GNUNET_BENCHMARK_suite_create ("PEERSTORE", "perf_peerstore_store");
   start = GNUNET_TIME_absolute_get ();
   if (0 !=
       GNUNET_TESTING_service_run ("perf-peerstore-store", "peerstore",
                                   "test_peerstore_api_data.conf", &run, NULL))
+  {
+    GNUNET_BENCHMARK_suite_destroy (suite);
+    return 1;
+  }
+  GNUNET_BENCHMARK_report (suite, "Store and retrieve", "records",
+                           GNUNET_TIME_absolute_get_duration (start), STORES);
+  if (GNUNET_OK != GNUNET_BENCHMARK_suite_destroy (suite))
     return 1;
-  diff = GNUNET_TIME_absolute_get_duration (start);
-  fprintf (stderr, "Stored and retrieved %d records in %s (%s).\n", STORES,
-           GNUNET_STRINGS_relative_time_to_string (diff, GNUNET_YES),
-           GNUNET_STRINGS_relative_time_to_string (diff, GNUNET_NO));
   return ok;
 }
 
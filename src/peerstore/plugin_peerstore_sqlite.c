@@ -42,6 +42,17 @@
  */
 #define BUSY_TIMEOUT_MS 1000
 
+/**
+ * How many modifications do we group into one transaction at most?
+ */
+#define COMMIT_BATCH_SIZE 128
+
+/**
+ * How long do we keep a transaction open at most before committing
+ * the modifications made so far?
+ */
+#define COMMIT_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
 /**
  * Log an error message at log-level 'level' that indicates
  * a failure of the command 'cmd' on file 'filename'
@@ -109,8 +120,159 @@ struct Plugin
    */
   sqlite3_stmt *delete_peerstoredata;
 
+  /**
+   * Precompiled SQL to start a transaction
+   */
+  sqlite3_stmt *begin_transaction;
+
+  /**
+   * Precompiled SQL to commit a transaction
+   */
+  sqlite3_stmt *commit_transaction;
+
+  /**
+   * Task committing the current transaction, NULL if no
+   * transaction is open.
+   */
+  struct GNUNET_SCHEDULER_Task *commit_task;
+
+  /**
+   * Number of modifications in the current transaction.
+   */
+  unsigned int pending_writes;
+
 };
 
+
+/**
+ * Run a precompiled statement that takes no arguments and
+ * returns no rows.
+ *
+ * @param plugin the plugin context
+ * @param stmt the statement
+ * @return #GNUNET_OK on success
+ */
+static int
+run_simple_statement (struct Plugin *plugin,
+                      sqlite3_stmt *stmt)
+{
+  int ret = GNUNET_OK;
+
+  if (SQLITE_DONE != sqlite3_step (stmt))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_step");
+    ret = GNUNET_SYSERR;
+  }
+  if (SQLITE_OK != sqlite3_reset (stmt))
+  {
+    LOG_SQLITE (plugin, GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK,
+                "sqlite3_reset");
+    ret = GNUNET_SYSERR;
+  }
+  return ret;
+}
+
+
+/* Forward declaration */
+static void
+commit_task (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Commit the open transaction.  If the commit fails and the
+ * transaction is still open (i.e. the database was busy), try
+ * again later.
+ *
+ * @param plugin the plugin context
+ */
+static void
+do_commit (struct Plugin *plugin)
+{
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Committing %u modifications\n",
+       plugin->pending_writes);
+  plugin->pending_writes = 0;
+  if ( (GNUNET_OK !=
+        run_simple_statement (plugin, plugin->commit_transaction)) &&
+       (0 == sqlite3_get_autocommit (plugin->dbh)) )
+    plugin->commit_task = GNUNET_SCHEDULER_add_delayed (COMMIT_DELAY,
+                                                        &commit_task,
+                                                        plugin);
+}
+
+
+/**
+ * Task committing the current transaction once #COMMIT_DELAY
+ * has passed.
+ *
+ * @param cls the plugin context
+ * @param tc scheduler context
+ */
+static void
+commit_task (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Plugin *plugin = cls;
+
+  plugin->commit_task = NULL;
+  do_commit (plugin);
+}
+
+
+/**
+ * Commit the current transaction, if any.
+ *
+ * @param plugin the plugin context
+ */
+static void
+commit_transaction (struct Plugin *plugin)
+{
+  if (NULL == plugin->commit_task)
+    return;
+  GNUNET_SCHEDULER_cancel (plugin->commit_task);
+  plugin->commit_task = NULL;
+  do_commit (plugin);
+}
+
+
+/**
+ * Make sure a transaction is open so that modifications are
+ * grouped instead of being committed one by one.
+ *
+ * @param plugin the plugin context
+ */
+static void
+begin_transaction (struct Plugin *plugin)
+{
+  if (NULL != plugin->commit_task)
+    return;
+  if (GNUNET_OK !=
+      run_simple_statement (plugin, plugin->begin_transaction))
+    return;                     /* fall back to autocommit */
+  plugin->commit_task = GNUNET_SCHEDULER_add_delayed (COMMIT_DELAY,
+                                                      &commit_task,
+                                                      plugin);
+}
+
+
+/**
+ * Account for a modification in the current transaction and
+ * commit it if the batch is full.
+ *
+ * @param plugin the plugin context
+ */
+static void
+modification_done (struct Plugin *plugin)
+{
+  if (NULL == plugin->commit_task)
+    return;
+  if (++plugin->pending_writes >= COMMIT_BATCH_SIZE)
+    commit_transaction (plugin);
+}
+
+
 /**
  * Delete records with the given key
  *
@@ -128,6 +290,7 @@ peerstore_sqlite_delete_records (void *cls, const char *sub_system,
   struct Plugin *plugin = cls;
   sqlite3_stmt *stmt = plugin->delete_peerstoredata;
 
+  begin_transaction (plugin);
   if ((SQLITE_OK !=
        sqlite3_bind_text (stmt, 1, sub_system, strlen (sub_system) + 1,
                           SQLITE_STATIC)) ||
@@ -151,6 +314,7 @@ peerstore_sqlite_delete_records (void *cls, const char *sub_system,
                 "sqlite3_reset");
     return 0;
   }
+  modification_done (plugin);
   return sqlite3_changes (plugin->dbh);
 }
 
@@ -173,6 +337,7 @@ peerstore_sqlite_expire_records (void *cls, struct GNUNET_TIME_Absolute now,
   struct Plugin *plugin = cls;
   sqlite3_stmt *stmt = plugin->expire_peerstoredata;
 
+  begin_transaction (plugin);
   if (SQLITE_OK !=
       sqlite3_bind_int64 (stmt, 1, (sqlite3_uint64) now.abs_value_us))
   {
@@ -190,6 +355,7 @@ peerstore_sqlite_expire_records (void *cls, struct GNUNET_TIME_Absolute now,
                 "sqlite3_reset");
     return GNUNET_SYSERR;
   }
+  modification_done (plugin);
   if (NULL != cont)
   {
     cont (cont_cls, sqlite3_changes (plugin->dbh));
@@ -318,7 +484,9 @@ peerstore_sqlite_iterate_records (void *cls, const char *sub_system,
 /**
  * Store a record in the peerstore.
  * Key is the combination of sub system and peer identity.
- * One key can store multiple values.
+ * One key can store multiple values.  Stores are grouped into
+ * transactions of up to #COMMIT_BATCH_SIZE records which are
+ * committed after at most #COMMIT_DELAY.
  *
  * @param cls closure (internal context for the plugin)
  * @param sub_system name of the GNUnet sub system responsible
@@ -344,6 +512,7 @@ peerstore_sqlite_store_record (void *cls, const char *sub_system,
   struct Plugin *plugin = cls;
   sqlite3_stmt *stmt = plugin->insert_peerstoredata;
 
+  begin_transaction (plugin);
   if (GNUNET_PEERSTORE_STOREOPTION_REPLACE == options)
   {
     peerstore_sqlite_delete_records (cls, sub_system, peer, key);
@@ -372,6 +541,7 @@ peerstore_sqlite_store_record (void *cls, const char *sub_system,
                 "sqlite3_reset");
     return GNUNET_SYSERR;
   }
+  modification_done (plugin);
   if (NULL != cont)
   {
     cont (cont_cls, GNUNET_OK);
@@ -425,22 +595,6 @@ sql_prepare (sqlite3 * dbh, const char *sql, sqlite3_stmt ** stmt)
 }
 
 
-/**
- * sqlite3 custom function for comparison of uint64_t values
- * since it is not supported by default
- */
-void
-sqlite3_lessthan (sqlite3_context * ctx, int dummy, sqlite3_value ** values)
-{
-  uint64_t v1;
-  uint64_t v2;
-
-  v1 = (uint64_t) sqlite3_value_int64 (values[0]);
-  v2 = (uint64_t) sqlite3_value_int64 (values[1]);
-  sqlite3_result_int (ctx, v1 < v2);
-}
-
-
 /**
  * Initialize the database connections and associated
  * data structures (create tables and indices
@@ -486,6 +640,7 @@ database_setup (struct Plugin *plugin)
   sql_exec (plugin->dbh, "PRAGMA auto_vacuum=INCREMENTAL");
   sql_exec (plugin->dbh, "PRAGMA encoding=\"UTF-8\"");
   sql_exec (plugin->dbh, "PRAGMA page_size=4096");
+  sql_exec (plugin->dbh, "PRAGMA journal_mode=WAL");
   sqlite3_busy_timeout (plugin->dbh, BUSY_TIMEOUT_MS);
   /* Create tables */
   sql_exec (plugin->dbh,
@@ -493,13 +648,15 @@ database_setup (struct Plugin *plugin)
             "  sub_system TEXT NOT NULL,\n" "  peer_id BLOB NOT NULL,\n"
             "  key TEXT NOT NULL,\n" "  value BLOB NULL,\n"
             "  expiry sqlite3_uint64 NOT NULL" ");");
-  sqlite3_create_function (plugin->dbh, "UINT64_LT", 2, SQLITE_UTF8, NULL,
-                           &sqlite3_lessthan, NULL, NULL);
   /* Create Indices */
-  if (SQLITE_OK !=
-      sqlite3_exec (plugin->dbh,
-                    "CREATE INDEX IF NOT EXISTS peerstoredata_key_index ON peerstoredata (sub_system, peer_id, key)",
-                    NULL, NULL, NULL))
+  if ( (SQLITE_OK !=
+        sqlite3_exec (plugin->dbh,
+                      "CREATE INDEX IF NOT EXISTS peerstoredata_key_index ON peerstoredata (sub_system, peer_id, key)",
+                      NULL, NULL, NULL)) ||
+       (SQLITE_OK !=
+        sqlite3_exec (plugin->dbh,
+                      "CREATE INDEX IF NOT EXISTS peerstoredata_expiry_index ON peerstoredata (expiry)",
+                      NULL, NULL, NULL)) )
   {
     LOG (GNUNET_ERROR_TYPE_ERROR, _("Unable to create indices: %s.\n"),
          sqlite3_errmsg (plugin->dbh));
@@ -523,13 +680,23 @@ database_setup (struct Plugin *plugin)
                "SELECT * FROM peerstoredata" " WHERE sub_system = ?"
                " AND peer_id = ?" " AND key = ?",
                &plugin->select_peerstoredata_by_all);
+  /* Expiration times are stored as signed 64-bit integers, so
+     "forever" (and anything else beyond 2^63) is negative; those
+     never expire.  Using a plain range keeps the expiry index usable. */
   sql_prepare (plugin->dbh,
-               "DELETE FROM peerstoredata" " WHERE UINT64_LT(expiry, ?)",
+               "DELETE FROM peerstoredata" " WHERE expiry >= 0"
+               " AND expiry < ?",
                &plugin->expire_peerstoredata);
   sql_prepare (plugin->dbh,
                "DELETE FROM peerstoredata" " WHERE sub_system = ?"
                " AND peer_id = ?" " AND key = ?",
                &plugin->delete_peerstoredata);
+  sql_prepare (plugin->dbh,
+               "BEGIN",
+               &plugin->begin_transaction);
+  sql_prepare (plugin->dbh,
+               "COMMIT",
+               &plugin->commit_transaction);
   return GNUNET_OK;
 }
 
@@ -545,6 +712,14 @@ database_shutdown (struct Plugin *plugin)
   int result;
   sqlite3_stmt *stmt;
 
+  commit_transaction (plugin);
+  if (NULL != plugin->commit_task)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Failed to commit pending modifications\n");
+    GNUNET_SCHEDULER_cancel (plugin->commit_task);
+    plugin->commit_task = NULL;
+  }
   while (NULL != (stmt = sqlite3_next_stmt (plugin->dbh, NULL)))
   {
     result = sqlite3_finalize (stmt);
@@ -208,6 +208,76 @@ struct Operation
 };
 
 
+/**
+ * State variable in the in-memory state of a channel.
+ */
+struct StateVar
+{
+  /**
+   * Name of the variable.
+   */
+  char *name;
+
+  /**
+   * Current value.
+   */
+  void *value;
+
+  /**
+   * Size of @a value.
+   */
+  uint32_t value_size;
+
+  /**
+   * ID of the message that last modified the variable,
+   * 0 if it was loaded from PSYCstore.
+   */
+  uint64_t message_id;
+};
+
+
+/**
+ * State request waiting for the state to be loaded from PSYCstore.
+ */
+struct StateWait
+{
+  struct StateWait *prev;
+  struct StateWait *next;
+
+  struct Operation *op;
+
+  /**
+   * Get all variables with the given name prefix?
+   * #GNUNET_YES or #GNUNET_NO
+   */
+  uint8_t is_prefix;
+
+  /* Followed by the variable name */
+};
+
+
+/**
+ * Status of the in-memory state of a channel.
+ */
+enum StateCacheStatus
+{
+  /**
+   * State is not in memory.
+   */
+  STATE_CACHE_EMPTY = 0,
+
+  /**
+   * State is being loaded from PSYCstore.
+   */
+  STATE_CACHE_LOADING = 1,
+
+  /**
+   * State is in memory and kept up to date.
+   */
+  STATE_CACHE_LOADED = 2,
+};
+
+
 /**
  * Common part of the client context for both a channel master and slave.
  */
@@ -238,6 +308,25 @@ struct Channel
    */
   struct GNUNET_CONTAINER_Heap *recv_msgs;
 
+  /**
+   * In-memory copy of the channel state, loaded from PSYCstore on the
+   * first state request, then updated with the modifiers of each
+   * stateful message after they were saved to PSYCstore.
+   * H(name) -> struct StateVar
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *state;
+
+  /**
+   * Operation loading @a state from PSYCstore.
+   */
+  struct GNUNET_PSYCSTORE_OperationHandle *state_load_op;
+
+  /**
+   * State requests waiting for @a state to be loaded.
+   */
+  struct StateWait *state_wait_head;
+  struct StateWait *state_wait_tail;
+
   /**
    * Public key of the channel.
    */
@@ -276,6 +365,11 @@ struct Channel
    */
   uint8_t tmit_state;
 
+  /**
+   * @see enum StateCacheStatus
+   */
+  uint8_t state_cache;
+
   /**
    * Is this a channel master (#GNUNET_YES), or slave (#GNUNET_NO)?
    */
@@ -428,6 +522,9 @@ message_queue_run (struct Channel *chn);
 static uint64_t
 message_queue_drop (struct Channel *chn);
 
+static void
+state_cache_clear (struct Channel *chn);
+
 
 /**
  * Task run during shutdown.
@@ -542,6 +639,7 @@ cleanup_channel (struct Channel *chn)
     GNUNET_PSYCSTORE_operation_cancel (chn->store_op);
     chn->store_op = NULL;
   }
+  state_cache_clear (chn);
 
   (GNUNET_YES == chn->is_master)
     ? cleanup_master ((struct Master *) chn)
@@ -1283,6 +1381,308 @@ fragment_queue_run (struct Channel *chn, uint64_t msg_id,
 }
 
 
+/**
+ * Free a state variable.
+ */
+static int
+state_var_free (void *cls, const struct GNUNET_HashCode *key, void *value)
+{
+  struct StateVar *var = value;
+  GNUNET_free (var->name);
+  GNUNET_free_non_null (var->value);
+  GNUNET_free (var);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Drop the in-memory state of a channel.
+ *
+ * The state is loaded again from PSYCstore on the next state request.
+ */
+static void
+state_cache_clear (struct Channel *chn)
+{
+  if (NULL != chn->state_load_op)
+  {
+    GNUNET_PSYCSTORE_operation_cancel (chn->state_load_op);
+    chn->state_load_op = NULL;
+  }
+  while (NULL != chn->state_wait_head)
+  {
+    struct StateWait *wait = chn->state_wait_head;
+    GNUNET_CONTAINER_DLL_remove (chn->state_wait_head, chn->state_wait_tail,
+                                 wait);
+    op_remove (wait->op);
+    GNUNET_free (wait);
+  }
+  if (NULL != chn->state)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (chn->state, state_var_free, NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (chn->state);
+    chn->state = NULL;
+  }
+  chn->state_cache = STATE_CACHE_EMPTY;
+}
+
+
+/**
+ * Look up a variable in the in-memory state of a channel.
+ */
+static struct StateVar *
+state_var_get (struct Channel *chn, const char *name)
+{
+  struct GNUNET_HashCode name_hash;
+  GNUNET_CRYPTO_hash (name, strlen (name), &name_hash);
+  return GNUNET_CONTAINER_multihashmap_get (chn->state, &name_hash);
+}
+
+
+/**
+ * Assign a value to a variable in the in-memory state of a channel.
+ *
+ * Like in PSYCstore, an empty value deletes the variable.
+ */
+static void
+state_var_assign (struct Channel *chn, const char *name,
+                  const void *value, uint32_t value_size, uint64_t message_id)
+{
+  struct GNUNET_HashCode name_hash;
+  GNUNET_CRYPTO_hash (name, strlen (name), &name_hash);
+  struct StateVar *
+    var = GNUNET_CONTAINER_multihashmap_get (chn->state, &name_hash);
+
+  if (0 == value_size)
+  {
+    if (NULL != var)
+    {
+      GNUNET_CONTAINER_multihashmap_remove (chn->state, &name_hash, var);
+      state_var_free (NULL, &name_hash, var);
+    }
+    return;
+  }
+
+  if (NULL == var)
+  {
+    var = GNUNET_new (struct StateVar);
+    var->name = GNUNET_strdup (name);
+    GNUNET_CONTAINER_multihashmap_put (chn->state, &name_hash, var,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+  }
+  else if (var->value_size != value_size)
+  {
+    GNUNET_free (var->value);
+    var->value = NULL;
+  }
+  if (NULL == var->value)
+    var->value = GNUNET_malloc (value_size);
+  memcpy (var->value, value, value_size);
+  var->value_size = value_size;
+  var->message_id = message_id;
+}
+
+
+/**
+ * Closure for applying the modifiers of a message to the in-memory state.
+ */
+struct StateApplyClosure
+{
+  struct Channel *chn;
+  uint64_t message_id;
+
+  /**
+   * Modifier being received in MOD_CONT parts.
+   */
+  char *mod_name;
+  char *mod_value;
+  uint32_t mod_value_size;
+  uint32_t mod_value_remaining;
+  uint8_t mod_oper;
+
+  /**
+   * #GNUNET_OK, or #GNUNET_SYSERR if the message could not be parsed.
+   */
+  int result;
+};
+
+
+/**
+ * Apply a message part to the in-memory state.
+ *
+ * Mirrors how PSYCstore applies the modifiers of a message:
+ * transient modifiers are ignored, and only the assign operator
+ * changes the state.
+ */
+static void
+state_apply_message_part (void *cls, uint64_t message_id,
+                          uint64_t data_offset, uint32_t flags,
+                          const struct GNUNET_MessageHeader *msg)
+{
+  struct StateApplyClosure *acls = cls;
+
+  if (NULL == msg)
+  {
+    acls->result = GNUNET_SYSERR;
+    return;
+  }
+
+  switch (ntohs (msg->type))
+  {
+  case GNUNET_MESSAGE_TYPE_PSYC_MESSAGE_MODIFIER:
+  {
+    const struct GNUNET_PSYC_MessageModifier *
+      pmod = (const struct GNUNET_PSYC_MessageModifier *) msg;
+    uint16_t psize = ntohs (pmod->header.size);
+    uint16_t name_size = ntohs (pmod->name_size);
+    uint32_t value_size = ntohl (pmod->value_size);
+    const char *name = (const char *) &pmod[1];
+    const char *value = name + name_size;
+
+    if (GNUNET_ENV_OP_ASSIGN != pmod->oper)
+      break;
+
+    if (psize == sizeof (*pmod) + name_size + value_size)
+    {
+      state_var_assign (acls->chn, name, value, value_size, acls->message_id);
+    }
+    else
+    {
+      acls->mod_oper = pmod->oper;
+      acls->mod_name = GNUNET_strdup (name);
+      acls->mod_value_size = value_size;
+      acls->mod_value = GNUNET_malloc (value_size);
+      acls->mod_value_remaining
+        = value_size - (psize - sizeof (*pmod) - name_size);
+      memcpy (acls->mod_value, value, value_size - acls->mod_value_remaining);
+    }
+    break;
+  }
+
+  case GNUNET_MESSAGE_TYPE_PSYC_MESSAGE_MOD_CONT:
+  {
+    uint16_t psize = ntohs (msg->size) - sizeof (*msg);
+
+    if (NULL == acls->mod_name)
+      break;
+    if (acls->mod_value_remaining < psize)
+    {
+      GNUNET_break_op (0);
+      acls->result = GNUNET_SYSERR;
+      break;
+    }
+    memcpy (acls->mod_value + acls->mod_value_size - acls->mod_value_remaining,
+            &msg[1], psize);
+    acls->mod_value_remaining -= psize;
+    if (0 == acls->mod_value_remaining)
+    {
+      state_var_assign (acls->chn, acls->mod_name,
+                        acls->mod_value, acls->mod_value_size,
+                        acls->message_id);
+      GNUNET_free (acls->mod_name);
+      GNUNET_free (acls->mod_value);
+      acls->mod_name = NULL;
+      acls->mod_value = NULL;
+    }
+    break;
+  }
+  }
+}
+
+
+/**
+ * Collect fragment IDs of a fragment queue.
+ */
+static int
+fragment_id_collect (void *cls, struct GNUNET_CONTAINER_HeapNode *node,
+                     void *element, GNUNET_CONTAINER_HeapCostType cost)
+{
+  uint64_t **frag_ids = cls;
+  **frag_ids = cost;
+  (*frag_ids)++;
+  return GNUNET_YES;
+}
+
+
+static int
+fragment_id_cmp (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+  return (x < y) ? -1 : (x > y);
+}
+
+
+/**
+ * Apply the modifiers of a message PSYCstore just saved to the state
+ * to the in-memory state as well, instead of reloading the whole state.
+ *
+ * The fragments of the message are still in @a recv_cache at this point.
+ * If any of them is missing, the in-memory state is dropped instead.
+ *
+ * @param chn    Channel.
+ * @param msg_id  ID of the message.
+ * @param fragq   Fragment queue of the message.
+ */
+static void
+state_cache_apply (struct Channel *chn, uint64_t msg_id,
+                   struct FragmentQueue *fragq)
+{
+  if (STATE_CACHE_LOADED != chn->state_cache)
+    return; /* the state being loaded already contains these changes */
+
+  struct GNUNET_CONTAINER_MultiHashMap *
+    chan_msgs = GNUNET_CONTAINER_multihashmap_get (recv_cache,
+                                                   &chn->pub_key_hash);
+  unsigned int frag_count = GNUNET_CONTAINER_heap_get_size (fragq->fragments);
+  if (0 == frag_count)
+    return;
+  uint64_t *frag_ids = GNUNET_malloc (frag_count * sizeof (*frag_ids));
+  uint64_t *frag_ids_end = frag_ids;
+  GNUNET_CONTAINER_heap_iterate (fragq->fragments, fragment_id_collect,
+                                 &frag_ids_end);
+  qsort (frag_ids, frag_count, sizeof (*frag_ids), fragment_id_cmp);
+
+  struct StateApplyClosure acls = {
+    .chn = chn,
+    .message_id = msg_id,
+    .result = GNUNET_OK,
+  };
+  struct GNUNET_PSYC_ReceiveHandle *
+    recv = GNUNET_PSYC_receive_create (NULL, state_apply_message_part, &acls);
+  unsigned int i;
+
+  for (i = 0; i < frag_count && GNUNET_OK == acls.result; i++)
+  {
+    struct GNUNET_HashCode frag_id_hash;
+    hash_key_from_hll (&frag_id_hash, frag_ids[i]);
+    struct RecvCacheEntry *cache_entry
+      = (NULL != chan_msgs)
+      ? GNUNET_CONTAINER_multihashmap_get (chan_msgs, &frag_id_hash)
+      : NULL;
+    if (NULL == cache_entry)
+    {
+      acls.result = GNUNET_SYSERR;
+      break;
+    }
+    struct GNUNET_PSYC_MessageHeader *
+      pmsg = GNUNET_PSYC_message_header_create (cache_entry->mmsg, 0);
+    GNUNET_PSYC_receive_message (recv, pmsg);
+    GNUNET_free (pmsg);
+  }
+  GNUNET_PSYC_receive_destroy (recv);
+  GNUNET_free_non_null (acls.mod_name);
+  GNUNET_free_non_null (acls.mod_value);
+  GNUNET_free (frag_ids);
+
+  if (GNUNET_OK != acls.result)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "%p Could not apply state modifiers of message %" PRIu64
+                " in memory, dropping state.\n", chn, msg_id);
+    state_cache_clear (chn);
+  }
+}
+
+
 struct StateModifyClosure
 {
   struct Channel *chn;
@@ -1309,6 +1709,11 @@ store_recv_state_modify_result (void *cls, int64_t result,
   switch (result)
   {
   case GNUNET_OK:
+    if (NULL != fragq)
+      state_cache_apply (chn, msg_id, fragq);
+    else if (STATE_CACHE_LOADED == chn->state_cache)
+      state_cache_clear (chn);
+    /* fall through */
   case GNUNET_NO:
     if (NULL != fragq)
       fragq->state_is_modified = GNUNET_YES;
@@ -2506,42 +2911,188 @@ store_recv_state_result (void *cls, int64_t result,
 
 
 /**
- * Client requests best matching state variable from PSYCstore.
+ * Send the result of a state request answered from the in-memory state.
  */
 static void
-client_recv_state_get (void *cls, struct GNUNET_SERVER_Client *client,
-                       const struct GNUNET_MessageHeader *msg)
+state_cache_send_result (struct Operation *op, int64_t result)
 {
-  struct Channel *
-    chn = GNUNET_SERVER_client_get_user_context (client, struct Channel);
-  GNUNET_assert (NULL != chn);
+  client_send_result (op->client, op->op_id, result, NULL, 0);
+  op_remove (op);
+}
 
-  const struct StateRequest *
-    req = (const struct StateRequest *) msg;
 
-  uint16_t name_size = ntohs (req->header.size) - sizeof (*req);
-  const char *name = (const char *) &req[1];
-  if (0 == name_size || '\0' != name[name_size - 1])
+/**
+ * Closure for state_var_send_prefix().
+ */
+struct StatePrefixClosure
+{
+  struct Operation *op;
+  const char *name;
+  size_t name_len;
+  int64_t result;
+};
+
+
+/**
+ * Send a state variable to the client if it matches the requested prefix.
+ */
+static int
+state_var_send_prefix (void *cls, const struct GNUNET_HashCode *key,
+                       void *value)
+{
+  struct StatePrefixClosure *pcls = cls;
+  struct StateVar *var = value;
+
+  if (0 == strncmp (var->name, pcls->name, pcls->name_len)
+      && ('\0' == var->name[pcls->name_len]
+          || '_' == var->name[pcls->name_len]))
   {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    store_recv_state_var (pcls->op, var->name, var->value, var->value_size);
+    pcls->result = GNUNET_OK;
+  }
+  return GNUNET_YES;
+}
+
+
+/**
+ * Answer a state request.
+ *
+ * Uses the in-memory state if it is loaded, otherwise the request is
+ * forwarded to PSYCstore.
+ *
+ * @param op         Operation of the request.
+ * @param name       Variable name or prefix.
+ * @param is_prefix  #GNUNET_YES for a prefix request, #GNUNET_NO for a
+ *                   best matching variable request.
+ */
+static void
+state_get (struct Operation *op, const char *name, uint8_t is_prefix)
+{
+  struct Channel *chn = op->chn;
+  size_t name_len = strlen (name);
+
+  if (STATE_CACHE_LOADED != chn->state_cache)
+  {
+    if (GNUNET_YES == is_prefix)
+      GNUNET_PSYCSTORE_state_get_prefix (store, &chn->pub_key, name,
+                                         &store_recv_state_var,
+                                         &store_recv_state_result, op);
+    else
+      GNUNET_PSYCSTORE_state_get (store, &chn->pub_key, name,
+                                  &store_recv_state_var,
+                                  &store_recv_state_result, op);
     return;
   }
 
-  struct Operation *op = op_add (chn, client, req->op_id, 0);
-  GNUNET_PSYCSTORE_state_get (store, &chn->pub_key, name,
-                              &store_recv_state_var,
-                              &store_recv_state_result, op);
-  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+  if (GNUNET_YES == is_prefix)
+  {
+    if (0 == name_len)
+    {
+      state_cache_send_result (op, GNUNET_SYSERR);
+      return;
+    }
+    struct StatePrefixClosure pcls = {
+      .op = op,
+      .name = name,
+      .name_len = name_len,
+      .result = GNUNET_NO,
+    };
+    GNUNET_CONTAINER_multihashmap_iterate (chn->state, state_var_send_prefix,
+                                           &pcls);
+    state_cache_send_result (op, pcls.result);
+    return;
+  }
+
+  if (name_len < 2)
+  {
+    state_cache_send_result (op, GNUNET_SYSERR);
+    return;
+  }
+
+  /* Find the best matching variable, like PSYCstore does:
+   * strip _segments from the end of the name until there's a match. */
+  char *p, *n = GNUNET_strdup (name);
+  struct StateVar *var = state_var_get (chn, n);
+  while (NULL == var && &n[1] < (p = strrchr (n, '_')))
+  {
+    *p = '\0';
+    var = state_var_get (chn, n);
+  }
+  GNUNET_free (n);
+
+  if (NULL != var)
+    store_recv_state_var (op, var->name, var->value, var->value_size);
+  state_cache_send_result (op, (NULL != var) ? GNUNET_OK : GNUNET_NO);
 }
 
 
 /**
- * Client requests state variables with a given prefix from PSYCstore.
+ * Received a state variable while loading the state from PSYCstore.
+ */
+static int
+state_load_var (void *cls, const char *name,
+                const void *value, uint32_t value_size)
+{
+  struct Channel *chn = cls;
+  state_var_assign (chn, name, value, value_size, 0);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Received result of loading the state from PSYCstore.
+ *
+ * Answer the state requests that were waiting for it.
  */
 static void
-client_recv_state_get_prefix (void *cls, struct GNUNET_SERVER_Client *client,
-                              const struct GNUNET_MessageHeader *msg)
+state_load_result (void *cls, int64_t result,
+                   const char *err_msg, uint16_t err_msg_size)
+{
+  struct Channel *chn = cls;
+  chn->state_load_op = NULL;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "%p Loading state from PSYCstore returned %" PRId64 " (%.*s)\n",
+              chn, result, err_msg_size, err_msg);
+
+  switch (result)
+  {
+  case GNUNET_OK:
+  case GNUNET_NO:
+    chn->state_cache = STATE_CACHE_LOADED;
+    break;
+
+  default:
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "%p Failed to load state from PSYCstore: %" PRId64 " (%.*s)\n",
+                chn, result, err_msg_size, err_msg);
+    GNUNET_CONTAINER_multihashmap_iterate (chn->state, state_var_free, NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (chn->state);
+    chn->state = NULL;
+    chn->state_cache = STATE_CACHE_EMPTY;
+  }
+
+  while (NULL != chn->state_wait_head)
+  {
+    struct StateWait *wait = chn->state_wait_head;
+    GNUNET_CONTAINER_DLL_remove (chn->state_wait_head, chn->state_wait_tail,
+                                 wait);
+    state_get (wait->op, (const char *) &wait[1], wait->is_prefix);
+    GNUNET_free (wait);
+  }
+}
+
+
+/**
+ * Handle a state request from the client.
+ *
+ * The first request loads the whole state of the channel from PSYCstore,
+ * requests arriving meanwhile wait for it to finish.
+ */
+static void
+client_recv_state_request (struct GNUNET_SERVER_Client *client,
+                           const struct GNUNET_MessageHeader *msg,
+                           uint8_t is_prefix)
 {
   struct Channel *
     chn = GNUNET_SERVER_client_get_user_context (client, struct Channel);
@@ -2560,13 +3111,57 @@ client_recv_state_get_prefix (void *cls, struct GNUNET_SERVER_Client *client,
   }
 
   struct Operation *op = op_add (chn, client, req->op_id, 0);
-  GNUNET_PSYCSTORE_state_get_prefix (store, &chn->pub_key, name,
-                                     &store_recv_state_var,
-                                     &store_recv_state_result, op);
+
+  if (STATE_CACHE_EMPTY == chn->state_cache)
+  {
+    chn->state = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
+    chn->state_cache = STATE_CACHE_LOADING;
+    /* All variable names start with _ */
+    chn->state_load_op
+      = GNUNET_PSYCSTORE_state_get_prefix (store, &chn->pub_key, "_",
+                                           &state_load_var,
+                                           &state_load_result, chn);
+  }
+
+  if (STATE_CACHE_LOADING == chn->state_cache)
+  {
+    struct StateWait *wait = GNUNET_malloc (sizeof (*wait) + name_size);
+    wait->op = op;
+    wait->is_prefix = is_prefix;
+    memcpy (&wait[1], name, name_size);
+    GNUNET_CONTAINER_DLL_insert_tail (chn->state_wait_head,
+                                      chn->state_wait_tail, wait);
+  }
+  else
+  {
+    state_get (op, name, is_prefix);
+  }
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
 
+/**
+ * Client requests best matching state variable.
+ */
+static void
+client_recv_state_get (void *cls, struct GNUNET_SERVER_Client *client,
+                       const struct GNUNET_MessageHeader *msg)
+{
+  client_recv_state_request (client, msg, GNUNET_NO);
+}
+
+
+/**
+ * Client requests state variables with a given prefix.
+ */
+static void
+client_recv_state_get_prefix (void *cls, struct GNUNET_SERVER_Client *client,
+                              const struct GNUNET_MessageHeader *msg)
+{
+  client_recv_state_request (client, msg, GNUNET_YES);
+}
+
+
 static const struct GNUNET_SERVER_MessageHandler server_handlers[] = {
   { &client_recv_master_start, NULL,
     GNUNET_MESSAGE_TYPE_PSYC_MASTER_START, 0 },
@@ -38,6 +38,45 @@
 #include "psycstore.h"
 
 
+/**
+ * Maximum number of fragments stored in one database transaction.
+ */
+#define MAX_STORE_BATCH 256
+
+
+/**
+ * Result of a fragment store request that is waiting for the
+ * transaction it is part of to be committed.
+ */
+struct StoreResult
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct StoreResult *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct StoreResult *prev;
+
+  /**
+   * Client that requested the store.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Operation ID in network byte order.
+   */
+  uint64_t op_id;
+
+  /**
+   * Result of storing the fragment.
+   */
+  int result;
+};
+
+
 /**
  * Handle to our current configuration.
  */
@@ -63,6 +102,35 @@ static struct GNUNET_PSYCSTORE_PluginFunctions *db;
  */
 static char *db_lib_name;
 
+/**
+ * Head of results of fragment stores in the current batch.
+ */
+static struct StoreResult *store_head;
+
+/**
+ * Tail of results of fragment stores in the current batch.
+ */
+static struct StoreResult *store_tail;
+
+/**
+ * Number of fragments in the current batch.
+ */
+static unsigned int store_count;
+
+/**
+ * Task committing the current batch.
+ */
+static struct GNUNET_SCHEDULER_Task *store_task;
+
+/**
+ * Is a fragment store transaction open?
+ */
+static int store_batch_open;
+
+
+static void
+store_batch_flush ();
+
 
 /**
  * Task run during shutdown.
@@ -73,6 +141,7 @@ static char *db_lib_name;
 static void
 shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  store_batch_flush ();
   if (NULL != nc)
   {
     GNUNET_SERVER_notification_context_destroy (nc);
@@ -131,6 +200,75 @@ send_result_code (struct GNUNET_SERVER_Client *client, uint64_t op_id,
 }
 
 
+/**
+ * Commit the current fragment store transaction, and send the
+ * results of the stores in it to the clients.
+ */
+static void
+store_batch_flush ()
+{
+  struct StoreResult *sr;
+  int ret = GNUNET_OK;
+
+  if (NULL != store_task)
+  {
+    GNUNET_SCHEDULER_cancel (store_task);
+    store_task = NULL;
+  }
+  if (GNUNET_YES == store_batch_open)
+  {
+    ret = db->fragment_store_end (db->cls);
+    if (GNUNET_OK != ret)
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  _("Failed to commit %u fragments!\n"), store_count);
+    store_batch_open = GNUNET_NO;
+  }
+  while (NULL != (sr = store_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (store_head, store_tail, sr);
+    if (NULL != nc && NULL != sr->client)
+      send_result_code (sr->client, sr->op_id,
+                        (GNUNET_OK == ret) ? sr->result : ret, NULL);
+    GNUNET_free (sr);
+  }
+  store_count = 0;
+}
+
+
+/**
+ * Task committing the current fragment store transaction once
+ * the stores pending in the input buffers were processed.
+ *
+ * @param cls unused
+ * @param tc unused
+ */
+static void
+store_batch_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  store_task = NULL;
+  store_batch_flush ();
+}
+
+
+/**
+ * A client disconnected, forget about its pending store results.
+ *
+ * @param cls unused
+ * @param client the client that disconnected
+ */
+static void
+client_disconnect_cb (void *cls, struct GNUNET_SERVER_Client *client)
+{
+  struct StoreResult *sr;
+
+  if (NULL == client)
+    return;
+  for (sr = store_head; NULL != sr; sr = sr->next)
+    if (sr->client == client)
+      sr->client = NULL;
+}
+
+
 enum
 {
   MEMBERSHIP_TEST_NOT_NEEDED = 0,
@@ -168,9 +306,69 @@ struct SendClosure
    * @see enum MessageMembershipTest
    */
   uint8_t membership_test;
+
+  /**
+   * Fragments not yet sent to the client, as a
+   * GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT_BATCH message.
+   */
+  struct FragmentBatchResult *batch;
+
+  /**
+   * Number of bytes used in @e batch.
+   */
+  size_t batch_size;
+
+  /**
+   * Number of fragments in @e batch.
+   */
+  uint32_t batch_count;
 };
 
 
+/**
+ * Send the fragments collected in @a sc to the client.
+ *
+ * @param sc
+ *        Closure with the fragments.
+ */
+static void
+send_fragment_batch (struct SendClosure *sc)
+{
+  if (0 == sc->batch_count)
+    return;
+  sc->batch->header.type
+    = htons (GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT_BATCH);
+  sc->batch->header.size = htons (sc->batch_size);
+  sc->batch->count = htonl (sc->batch_count);
+  sc->batch->op_id = sc->op_id;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sending %u fragments to client\n", sc->batch_count);
+  GNUNET_SERVER_notification_context_add (nc, sc->client);
+  GNUNET_SERVER_notification_context_unicast (nc, sc->client,
+                                              &sc->batch->header, GNUNET_NO);
+  sc->batch_size = sizeof (struct FragmentBatchResult);
+  sc->batch_count = 0;
+}
+
+
+/**
+ * Send the remaining fragments collected in @a sc to the client,
+ * and release the batch buffer.
+ *
+ * @param sc
+ *        Closure with the fragments.
+ */
+static void
+send_fragment_batch_done (struct SendClosure *sc)
+{
+  if (NULL == sc->batch)
+    return;
+  send_fragment_batch (sc);
+  GNUNET_free (sc->batch);
+  sc->batch = NULL;
+}
+
+
 static int
 send_fragment (void *cls, struct GNUNET_MULTICAST_MessageHeader *msg,
                enum GNUNET_PSYCSTORE_MessageFlags flags)
@@ -196,7 +394,30 @@ send_fragment (void *cls, struct GNUNET_MULTICAST_MessageHeader *msg,
   }
 
   size_t msg_size = ntohs (msg->header.size);
+  struct FragmentBatchEntry *entry;
 
+  if (sizeof (struct FragmentBatchResult) + sizeof (*entry) + msg_size
+      < GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    /* collect fragments and send as many as fit in one message */
+    if (NULL == sc->batch)
+    {
+      sc->batch = GNUNET_malloc (GNUNET_SERVER_MAX_MESSAGE_SIZE - 1);
+      sc->batch_size = sizeof (struct FragmentBatchResult);
+    }
+    if (GNUNET_SERVER_MAX_MESSAGE_SIZE - 1
+        < sc->batch_size + sizeof (*entry) + msg_size)
+      send_fragment_batch (sc);
+    entry = (struct FragmentBatchEntry *) ((char *) sc->batch + sc->batch_size);
+    entry->psycstore_flags = htonl (flags);
+    memcpy (&entry[1], msg, msg_size);
+    sc->batch_size += sizeof (*entry) + msg_size;
+    sc->batch_count++;
+    GNUNET_free (msg);
+    return GNUNET_YES;
+  }
+
+  send_fragment_batch (sc);
   res = GNUNET_malloc (sizeof (struct FragmentResult) + msg_size);
   res->header.type = htons (GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT);
   res->header.size = htons (sizeof (struct FragmentResult) + msg_size);
@@ -250,6 +471,8 @@ handle_membership_store (void *cls,
   const struct MembershipStoreRequest *req =
     (const struct MembershipStoreRequest *) msg;
 
+  store_batch_flush ();
+
   int ret = db->membership_store (db->cls, &req->channel_key, &req->slave_key,
                                   req->did_join,
                                   GNUNET_ntohll (req->announced_at),
@@ -273,6 +496,8 @@ handle_membership_test (void *cls,
   const struct MembershipTestRequest *req =
     (const struct MembershipTestRequest *) msg;
 
+  store_batch_flush ();
+
   int ret = db->membership_test (db->cls, &req->channel_key, &req->slave_key,
                                  GNUNET_ntohll (req->message_id));
   switch (ret)
@@ -298,6 +523,14 @@ handle_fragment_store (void *cls,
   const struct FragmentStoreRequest *req =
     (const struct FragmentStoreRequest *) msg;
 
+  struct StoreResult *sr;
+
+  /* Consecutive stores share one transaction, which is committed
+   * once no more of them are waiting in the input buffers. */
+  if (GNUNET_NO == store_batch_open
+      && GNUNET_OK == db->fragment_store_begin (db->cls))
+    store_batch_open = GNUNET_YES;
+
   int ret = db->fragment_store (db->cls, &req->channel_key,
                                 (const struct GNUNET_MULTICAST_MessageHeader *)
                                 &req[1], ntohl (req->psycstore_flags));
@@ -306,7 +539,15 @@ handle_fragment_store (void *cls,
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 _("Failed to store fragment!\n"));
 
-  send_result_code (client, req->op_id, ret, NULL);
+  sr = GNUNET_new (struct StoreResult);
+  sr->client = client;
+  sr->op_id = req->op_id;
+  sr->result = ret;
+  GNUNET_CONTAINER_DLL_insert_tail (store_head, store_tail, sr);
+  if (MAX_STORE_BATCH <= ++store_count || GNUNET_YES != store_batch_open)
+    store_batch_flush ();
+  else if (NULL == store_task)
+    store_task = GNUNET_SCHEDULER_add_now (&store_batch_task, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -318,6 +559,9 @@ handle_fragment_get (void *cls,
 {
   const struct FragmentGetRequest *
     req = (const struct FragmentGetRequest *) msg;
+
+  store_batch_flush ();
+
   struct SendClosure
     sc = { .op_id = req->op_id, .client = client,
            .channel_key = req->channel_key, .slave_key = req->slave_key,
@@ -362,6 +606,7 @@ handle_fragment_get (void *cls,
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
                 _("Failed to get fragment!\n"));
   }
+  send_fragment_batch_done (&sc);
   send_result_code (client, req->op_id, (ret < 0) ? ret : ret_frags, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
@@ -374,6 +619,9 @@ handle_message_get (void *cls,
 {
   const struct MessageGetRequest *
     req = (const struct MessageGetRequest *) msg;
+
+  store_batch_flush ();
+
   uint16_t size = ntohs (msg->size);
   const char *method_prefix = (const char *) &req[1];
 
@@ -418,6 +666,7 @@ handle_message_get (void *cls,
                 _("Failed to get message!\n"));
   }
 
+  send_fragment_batch_done (&sc);
   send_result_code (client, req->op_id, (ret < 0) ? ret : ret_frags, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
@@ -430,6 +679,9 @@ handle_message_get_fragment (void *cls,
 {
   const struct MessageGetFragmentRequest *
     req = (const struct MessageGetFragmentRequest *) msg;
+
+  store_batch_flush ();
+
   struct SendClosure
     sc = { .op_id = req->op_id, .client = client,
            .channel_key = req->channel_key, .slave_key = req->slave_key,
@@ -449,6 +701,7 @@ handle_message_get_fragment (void *cls,
                 _("Failed to get message fragment!\n"));
   }
 
+  send_fragment_batch_done (&sc);
   send_result_code (client, req->op_id, ret, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
@@ -460,6 +713,9 @@ handle_counters_get (void *cls,
                      const struct GNUNET_MessageHeader *msg)
 {
   const struct OperationRequest *req = (const struct OperationRequest *) msg;
+
+  store_batch_flush ();
+
   struct CountersResult res = { {0} };
 
   int ret = db->counters_message_get (db->cls, &req->channel_key,
@@ -642,6 +898,8 @@ handle_state_modify (void *cls,
   const struct StateModifyRequest *req
     = (const struct StateModifyRequest *) msg;
 
+  store_batch_flush ();
+
   uint64_t message_id = GNUNET_ntohll (req->message_id);
   uint64_t state_delta = GNUNET_ntohll (req->state_delta);
   uint64_t ret_frags = 0;
@@ -696,6 +954,8 @@ handle_state_sync (void *cls,
   const struct StateSyncRequest *req
     = (const struct StateSyncRequest *) msg;
 
+  store_batch_flush ();
+
   int ret = GNUNET_SYSERR;
   const char *name = (const char *) &req[1];
   uint16_t name_size = ntohs (req->name_size);
@@ -750,6 +1010,8 @@ handle_state_reset (void *cls,
   const struct OperationRequest *req =
     (const struct OperationRequest *) msg;
 
+  store_batch_flush ();
+
   int ret = db->state_reset (db->cls, &req->channel_key);
 
   if (ret != GNUNET_OK)
@@ -769,6 +1031,8 @@ handle_state_hash_update (void *cls,
   const struct OperationRequest *req =
     (const struct OperationRequest *) msg;
 
+  store_batch_flush ();
+
   int ret = db->state_reset (db->cls, &req->channel_key);
 
   if (ret != GNUNET_OK)
@@ -788,6 +1052,8 @@ handle_state_get (void *cls,
   const struct OperationRequest *req =
     (const struct OperationRequest *) msg;
 
+  store_batch_flush ();
+
   struct SendClosure sc = { .op_id = req->op_id, .client = client };
   int64_t ret = GNUNET_SYSERR;
   const char *name = (const char *) &req[1];
@@ -839,6 +1105,8 @@ handle_state_get_prefix (void *cls,
   const struct OperationRequest *req =
     (const struct OperationRequest *) msg;
 
+  store_batch_flush ();
+
   struct SendClosure sc = { .op_id = req->op_id, .client = client };
   int64_t ret = GNUNET_SYSERR;
   const char *name = (const char *) &req[1];
@@ -959,6 +1227,7 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   stats = GNUNET_STATISTICS_create ("psycstore", cfg);
   GNUNET_SERVER_add_handlers (server, handlers);
   nc = GNUNET_SERVER_notification_context_create (server, 1);
+  GNUNET_SERVER_disconnect_notify (server, &client_disconnect_cb, NULL);
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL, &shutdown_task,
                                 NULL);
 }
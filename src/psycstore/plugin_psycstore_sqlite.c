@@ -66,6 +66,7 @@ enum Transactions {
   TRANSACTION_NONE = 0,
   TRANSACTION_STATE_MODIFY,
   TRANSACTION_STATE_SYNC,
+  TRANSACTION_FRAGMENT_STORE,
 };
 
 /**
@@ -340,6 +341,7 @@ database_setup (struct Plugin *plugin)
   sql_exec (plugin->dbh, "PRAGMA locking_mode=EXCLUSIVE");
 #endif
   sql_exec (plugin->dbh, "PRAGMA page_size=4096");
+  sql_exec (plugin->dbh, "PRAGMA journal_mode=WAL");
 
   sqlite3_busy_timeout (plugin->dbh, BUSY_TIMEOUT_MS);
 
@@ -389,6 +391,12 @@ database_setup (struct Plugin *plugin)
             "  PRIMARY KEY (channel_id, fragment_id),\n"
             "  UNIQUE (channel_id, message_id, fragment_offset)\n"
             ");");
+  /* covers counter lookups and fragment ID range probes without
+   * touching the rows with the fragment payloads */
+  sql_exec (plugin->dbh,
+            "CREATE INDEX IF NOT EXISTS idx_messages_channel_id_fragment_id "
+            "ON messages (channel_id, fragment_id, message_id, "
+            "group_generation);");
 
   sql_exec (plugin->dbh,
             "CREATE TABLE IF NOT EXISTS state (\n"
@@ -462,7 +470,8 @@ database_setup (struct Plugin *plugin)
                "       multicast_flags, psycstore_flags, data\n"
                "FROM messages\n"
                "WHERE channel_id = (SELECT id FROM channels WHERE pub_key = ?)\n"
-               "      AND ? <= fragment_id AND fragment_id <= ?;",
+               "      AND ? <= fragment_id AND fragment_id <= ?\n"
+               "ORDER BY fragment_id;",
                &plugin->select_fragments);
 
   /** @todo select_messages: add method_prefix filter */
@@ -929,7 +938,8 @@ fragment_store (void *cls,
   struct Plugin *plugin = cls;
   sqlite3_stmt *stmt = plugin->insert_fragment;
 
-  GNUNET_assert (TRANSACTION_NONE == plugin->transaction);
+  GNUNET_assert (TRANSACTION_NONE == plugin->transaction
+                 || TRANSACTION_FRAGMENT_STORE == plugin->transaction);
 
   uint64_t fragment_id = GNUNET_ntohll (msg->fragment_id);
   uint64_t fragment_offset = GNUNET_ntohll (msg->fragment_offset);
@@ -986,6 +996,47 @@ fragment_store (void *cls,
   return GNUNET_OK;
 }
 
+
+/**
+ * Begin storing a batch of message fragments.
+ *
+ * @see GNUNET_PSYCSTORE_PluginFunctions.fragment_store_begin
+ *
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+fragment_store_begin (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  if (TRANSACTION_NONE != plugin->transaction)
+    return GNUNET_SYSERR;
+  return transaction_begin (plugin, TRANSACTION_FRAGMENT_STORE);
+}
+
+
+/**
+ * Commit a batch of message fragments.
+ *
+ * @see GNUNET_PSYCSTORE_PluginFunctions.fragment_store_end
+ *
+ * @return #GNUNET_OK on success, else #GNUNET_SYSERR
+ */
+static int
+fragment_store_end (void *cls)
+{
+  struct Plugin *plugin = cls;
+
+  GNUNET_assert (TRANSACTION_FRAGMENT_STORE == plugin->transaction);
+  if (GNUNET_OK != transaction_commit (plugin))
+  {
+    transaction_rollback (plugin);
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
 /**
  * Set additional flags for a given message.
  *
@@ -1900,6 +1951,8 @@ libgnunet_plugin_psycstore_sqlite_init (void *cls)
   api->membership_store = &membership_store;
   api->membership_test = &membership_test;
   api->fragment_store = &fragment_store;
+  api->fragment_store_begin = &fragment_store_begin;
+  api->fragment_store_end = &fragment_store_end;
   api->message_add_flags = &message_add_flags;
   api->fragment_get = &fragment_get;
   api->fragment_get_latest = &fragment_get_latest;
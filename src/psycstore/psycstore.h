@@ -115,6 +115,45 @@ struct FragmentResult
 };
 
 
+/**
+ * Answer from service to client containing several message fragments.
+ */
+struct FragmentBatchResult
+{
+  /**
+   * Type: GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT_BATCH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of fragments in this message.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /**
+   * Operation ID.
+   */
+  uint64_t op_id GNUNET_PACKED;
+
+  /* Followed by @e count times a FragmentBatchEntry
+   * and a GNUNET_MULTICAST_MessageHeader */
+};
+
+
+/**
+ * Header of a fragment in a FragmentBatchResult.
+ */
+struct FragmentBatchEntry
+{
+  /**
+   * enum GNUNET_PSYCSTORE_MessageFlags
+   */
+  uint32_t psycstore_flags GNUNET_PACKED;
+
+  /* Followed by GNUNET_MULTICAST_MessageHeader */
+};
+
+
 /**
  * Answer from service to client containing a state variable.
  */
@@ -246,6 +246,7 @@ message_handler (void *cls, const struct GNUNET_MessageHeader *msg)
   const struct OperationResult *opres;
   const struct CountersResult *cres;
   const struct FragmentResult *fres;
+  const struct FragmentBatchResult *bres;
   const struct StateResult *sres;
   const char *str;
 
@@ -397,6 +398,77 @@ message_handler (void *cls, const struct GNUNET_MessageHeader *msg)
     }
     break;
 
+  case GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_FRAGMENT_BATCH:
+    if (size < sizeof (struct FragmentBatchResult))
+    {
+      LOG (GNUNET_ERROR_TYPE_ERROR,
+           "Received message of type %d with length %lu bytes. "
+           "Expected >= %lu\n",
+           type, size, sizeof (struct FragmentBatchResult));
+      GNUNET_break (0);
+      reschedule_connect (h);
+      return;
+    }
+
+    bres = (const struct FragmentBatchResult *) msg;
+    uint32_t count = ntohl (bres->count);
+    const char *pos = (const char *) &bres[1];
+    size_t left = size - sizeof (struct FragmentBatchResult);
+    uint32_t i;
+
+    /* validate the whole batch before handing out any fragment */
+    for (i = 0; i < count; i++)
+    {
+      const struct GNUNET_MULTICAST_MessageHeader *bmsg =
+        (const struct GNUNET_MULTICAST_MessageHeader *)
+        (pos + sizeof (struct FragmentBatchEntry));
+      size_t entry_size;
+
+      if (left < sizeof (struct FragmentBatchEntry) + sizeof (*bmsg))
+        break;
+      entry_size = sizeof (struct FragmentBatchEntry)
+        + ntohs (bmsg->header.size);
+      if (ntohs (bmsg->header.size) < sizeof (*bmsg) || left < entry_size)
+        break;
+      pos += entry_size;
+      left -= entry_size;
+    }
+    if (i != count || 0 != left)
+    {
+      LOG (GNUNET_ERROR_TYPE_ERROR,
+           "Received malformed fragment batch of %u fragments "
+           "and %u bytes.\n",
+           count, size);
+      GNUNET_break (0);
+      reschedule_connect (h);
+      return;
+    }
+
+    op = find_op_by_id (h, GNUNET_ntohll (bres->op_id));
+    if (NULL == op)
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "No callback registered for operation with ID %" PRIu64 ".\n",
+           GNUNET_ntohll (bres->op_id));
+    }
+    pos = (const char *) &bres[1];
+    for (i = 0; i < count && NULL != op; i++)
+    {
+      const struct FragmentBatchEntry *entry =
+        (const struct FragmentBatchEntry *) pos;
+      struct GNUNET_MULTICAST_MessageHeader *bmsg =
+        (struct GNUNET_MULTICAST_MessageHeader *) &entry[1];
+
+      pos += sizeof (*entry) + ntohs (bmsg->header.size);
+      if (NULL == op->data_cb)
+        break;
+      ((GNUNET_PSYCSTORE_FragmentCallback)
+       op->data_cb) (op->cls, bmsg, ntohl (entry->psycstore_flags));
+      /* the callback may have cancelled the operation */
+      op = find_op_by_id (h, GNUNET_ntohll (bres->op_id));
+    }
+    break;
+
   case GNUNET_MESSAGE_TYPE_PSYCSTORE_RESULT_STATE:
     if (size < sizeof (struct StateResult))
     {
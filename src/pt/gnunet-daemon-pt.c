@@ -57,30 +57,17 @@
 
 
 /**
- * Which group of DNS records are we currently processing?
+ * How many VPN mappings do we remember at most?  Should be well
+ * below the VPN's MAX_MAPPING, so that cached mappings are unlikely
+ * to have been expired by the VPN service under pressure.
  */
-enum RequestGroup
-{
-  /**
-   * DNS answers
-   */
-  ANSWERS = 0,
-
-  /**
-   * DNS authority records
-   */
-  AUTHORITY_RECORDS = 1,
+#define MAX_MAPPING_CACHE_SIZE 128
 
-  /**
-   * DNS additional records
-   */
-  ADDITIONAL_RECORDS = 2,
-
-  /**
-   * We're done processing.
-   */
-  END = 3
-};
+/**
+ * How long do we reuse a VPN mapping for further DNS replies?
+ * Must be shorter than the expiration time we request from the VPN.
+ */
+#define MAPPING_CACHE_TTL GNUNET_TIME_relative_divide (TIMEOUT, 2)
 
 
 /**
@@ -104,19 +91,64 @@ struct ReplyContext
   struct GNUNET_VPN_RedirectionRequest *rr;
 
   /**
-   * Record for which we have an active redirection request.
+   * Records (from all sections of @e dns) that still need a
+   * mapping from the VPN.
    */
-  struct GNUNET_DNSPARSER_Record *rec;
+  struct GNUNET_DNSPARSER_Record **recs;
 
   /**
-   * Offset in the current record group that is being modified.
+   * Number of entries in @e recs.
+   */
+  unsigned int recs_len;
+
+  /**
+   * Offset in @e recs of the first record of the active
+   * redirection request.
    */
   unsigned int offset;
 
   /**
-   * Group that is being modified
+   * Number of records in the active redirection request.
+   */
+  unsigned int batch_len;
+
+};
+
+
+/**
+ * Mapping from an Internet address to an address of the VPN that we
+ * obtained recently and may reuse for further DNS replies.
+ */
+struct MappingCacheEntry
+{
+  /**
+   * Entry in #mapping_heap.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Until when may we reuse this mapping?
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Key of this entry in #mapping_cache.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Address family of @e vpn_addr (matches the original).
+   */
+  int af;
+
+  /**
+   * Address of the VPN to use for the original address.
    */
-  enum RequestGroup group;
+  union
+  {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } vpn_addr;
 
 };
 
@@ -291,6 +323,17 @@ static struct GNUNET_DNS_Handle *dns_post_handle;
  */
 static struct GNUNET_DNS_Handle *dns_pre_handle;
 
+/**
+ * Recent VPN mappings, maps hashes of Internet addresses to
+ * `struct MappingCacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *mapping_cache;
+
+/**
+ * Recent VPN mappings, ordered by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *mapping_heap;
+
 /**
  * Handle to access the DHT.
  */
@@ -469,14 +512,14 @@ choose_exit ()
 static void
 finish_request (struct ReplyContext *rc)
 {
-  char *buf;
+  char buf[MAX_DNS_SIZE];
   size_t buf_len;
 
   if (GNUNET_SYSERR ==
-      GNUNET_DNSPARSER_pack (rc->dns,
-			     MAX_DNS_SIZE,
-			     &buf,
-			     &buf_len))
+      GNUNET_DNSPARSER_pack_to_buffer (rc->dns,
+                                       buf,
+                                       sizeof (buf),
+                                       &buf_len))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
 		_("Failed to pack DNS request.  Dropping.\n"));
@@ -489,206 +532,296 @@ finish_request (struct ReplyContext *rc)
 			      1, GNUNET_NO);
     GNUNET_DNS_request_answer (rc->rh,
 			       buf_len, buf);
-    GNUNET_free (buf);
   }
   GNUNET_DNSPARSER_free_packet (rc->dns);
+  GNUNET_free_non_null (rc->recs);
   GNUNET_free (rc);
 }
 
 
 /**
- * Process the next record of the given request context.
- * When done, submit the reply and free the resources of
- * the rc.
+ * Remove an entry from the mapping cache.
  *
- * @param rc context to process
+ * @param me entry to remove
  */
 static void
-submit_request (struct ReplyContext *rc);
+free_mapping (struct MappingCacheEntry *me)
+{
+  GNUNET_CONTAINER_heap_remove_node (me->hn);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (mapping_cache,
+                                                       &me->key,
+                                                       me));
+  GNUNET_free (me);
+}
 
 
 /**
- * Callback invoked from the VPN service once a redirection is
- * available.  Provides the IP address that can now be used to
- * reach the requested destination.  We substitute the active
- * record and then continue with 'submit_request' to look at
- * the other records.
+ * Look for a recent VPN mapping for the address in a DNS record.
  *
- * @param cls our `struct ReplyContext`
- * @param af address family, AF_INET or AF_INET6; AF_UNSPEC on error;
- *                will match 'result_af' from the request
- * @param address IP address (struct in_addr or struct in_addr6, depending on 'af')
- *                that the VPN allocated for the redirection;
- *                traffic to this IP will now be redirected to the
- *                specified target peer; NULL on error
+ * @param rec A or AAAA record
+ * @return NULL if we have no (valid) mapping for the record
  */
-static void
-vpn_allocation_callback (void *cls,
-			 int af,
-			 const void *address)
+static struct MappingCacheEntry *
+lookup_mapping (const struct GNUNET_DNSPARSER_Record *rec)
 {
-  struct ReplyContext *rc = cls;
-
-  rc->rr = NULL;
-  if (af == AF_UNSPEC)
+  struct GNUNET_HashCode key;
+  struct MappingCacheEntry *me;
+
+  GNUNET_CRYPTO_hash (rec->data.raw.data,
+                      rec->data.raw.data_len,
+                      &key);
+  me = GNUNET_CONTAINER_multihashmap_get (mapping_cache,
+                                          &key);
+  if (NULL == me)
+    return NULL;
+  if (0 == GNUNET_TIME_absolute_get_remaining (me->expiration).rel_value_us)
   {
-    GNUNET_DNS_request_drop (rc->rh);
-    GNUNET_DNSPARSER_free_packet (rc->dns);
-    GNUNET_free (rc);
-    return;
+    free_mapping (me);
+    return NULL;
   }
+  return me;
+}
+
+
+/**
+ * Remember the VPN mapping for the address in a DNS record.
+ *
+ * @param rec A or AAAA record with the original address
+ * @param allocation address the VPN allocated for it
+ */
+static void
+cache_mapping (const struct GNUNET_DNSPARSER_Record *rec,
+               const struct GNUNET_VPN_IpAllocation *allocation)
+{
+  struct MappingCacheEntry *me;
+
+  if (NULL != (me = lookup_mapping (rec)))
+    free_mapping (me);
+  if (GNUNET_CONTAINER_multihashmap_size (mapping_cache) >= MAX_MAPPING_CACHE_SIZE)
+    free_mapping (GNUNET_CONTAINER_heap_peek (mapping_heap));
+  me = GNUNET_new (struct MappingCacheEntry);
+  GNUNET_CRYPTO_hash (rec->data.raw.data,
+                      rec->data.raw.data_len,
+                      &me->key);
+  me->af = allocation->af;
+  me->vpn_addr.v6 = allocation->address.v6;
+  me->expiration = GNUNET_TIME_relative_to_absolute (MAPPING_CACHE_TTL);
+  me->hn = GNUNET_CONTAINER_heap_insert (mapping_heap,
+                                         me,
+                                         me->expiration.abs_value_us);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (mapping_cache,
+                                                    &me->key,
+                                                    me,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+}
+
+
+/**
+ * Substitute the address in a DNS record with the one from the VPN.
+ *
+ * @param rec A or AAAA record to modify
+ * @param af address family of @a address
+ * @param address address to use
+ */
+static void
+set_address (struct GNUNET_DNSPARSER_Record *rec,
+             int af,
+             const void *address)
+{
   GNUNET_STATISTICS_update (stats,
 			    gettext_noop ("# DNS records modified"),
 			    1, GNUNET_NO);
-  switch (rc->rec->type)
+  switch (rec->type)
   {
   case GNUNET_DNSPARSER_TYPE_A:
     GNUNET_assert (AF_INET == af);
-    memcpy (rc->rec->data.raw.data, address, sizeof (struct in_addr));
+    memcpy (rec->data.raw.data, address, sizeof (struct in_addr));
     break;
   case GNUNET_DNSPARSER_TYPE_AAAA:
     GNUNET_assert (AF_INET6 == af);
-    memcpy (rc->rec->data.raw.data, address, sizeof (struct in6_addr));
+    memcpy (rec->data.raw.data, address, sizeof (struct in6_addr));
     break;
   default:
     GNUNET_assert (0);
     return;
   }
-  rc->rec = NULL;
-  submit_request (rc);
 }
 
 
 /**
- * Modify the given DNS record by asking VPN to create a channel
- * to the given address.  When done, continue with submitting
- * other records from the request context ('submit_request' is
- * our continuation).
+ * Ask the VPN for mappings for the next batch of records of the
+ * given request context.  When done, submit the reply and free the
+ * resources of the rc.
  *
  * @param rc context to process
- * @param rec record to modify
  */
 static void
-modify_address (struct ReplyContext *rc,
-		struct GNUNET_DNSPARSER_Record *rec)
+submit_request (struct ReplyContext *rc);
+
+
+/**
+ * Callback invoked from the VPN service once the redirections for a
+ * batch of records are available.  We substitute the records and
+ * then continue with 'submit_request' to look at the other records.
+ *
+ * @param cls our `struct ReplyContext`
+ * @param count number of entries in @a allocations
+ * @param allocations IPs allocated for the records of the batch
+ */
+static void
+vpn_allocation_callback (void *cls,
+			 unsigned int count,
+			 const struct GNUNET_VPN_IpAllocation *allocations)
 {
-  int af;
+  struct ReplyContext *rc = cls;
+  struct GNUNET_DNSPARSER_Record *rec;
+  unsigned int i;
 
-  switch (rec->type)
+  rc->rr = NULL;
+  GNUNET_assert (count == rc->batch_len);
+  for (i=0;i<count;i++)
   {
-  case GNUNET_DNSPARSER_TYPE_A:
-    af = AF_INET;
-    GNUNET_assert (rec->data.raw.data_len == sizeof (struct in_addr));
-    break;
-  case GNUNET_DNSPARSER_TYPE_AAAA:
-    af = AF_INET6;
-    GNUNET_assert (rec->data.raw.data_len == sizeof (struct in6_addr));
-    break;
-  default:
-    GNUNET_assert (0);
-    return;
+    if (AF_UNSPEC == allocations[i].af)
+    {
+      GNUNET_DNS_request_drop (rc->rh);
+      GNUNET_DNSPARSER_free_packet (rc->dns);
+      GNUNET_free (rc->recs);
+      GNUNET_free (rc);
+      return;
+    }
   }
-  rc->rec = rec;
-  rc->rr = GNUNET_VPN_redirect_to_ip (vpn_handle,
-				      af, af,
-				      rec->data.raw.data,
-				      GNUNET_TIME_relative_to_absolute (TIMEOUT),
-				      &vpn_allocation_callback,
-				      rc);
+  for (i=0;i<count;i++)
+  {
+    rec = rc->recs[rc->offset + i];
+    cache_mapping (rec, &allocations[i]);
+    set_address (rec,
+                 allocations[i].af,
+                 &allocations[i].address);
+  }
+  rc->offset += count;
+  rc->batch_len = 0;
+  submit_request (rc);
 }
 
 
 /**
- * Process the next record of the given request context.
- * When done, submit the reply and free the resources of
- * the rc.
+ * Ask the VPN for mappings for the next batch of records of the
+ * given request context.  When done, submit the reply and free the
+ * resources of the rc.
  *
  * @param rc context to process
  */
 static void
 submit_request (struct ReplyContext *rc)
 {
-  struct GNUNET_DNSPARSER_Record *ra;
-  unsigned int ra_len;
+  struct GNUNET_VPN_IpDestination dests[GNUNET_VPN_MAX_BATCH_SIZE];
+  struct GNUNET_DNSPARSER_Record *rec;
   unsigned int i;
 
-  while (1)
+  if (rc->offset == rc->recs_len)
+  {
+    finish_request (rc);
+    return;
+  }
+  rc->batch_len = GNUNET_MIN (rc->recs_len - rc->offset,
+                              GNUNET_VPN_MAX_BATCH_SIZE);
+  memset (dests, 0, sizeof (dests));
+  for (i=0;i<rc->batch_len;i++)
   {
-    switch (rc->group)
+    rec = rc->recs[rc->offset + i];
+    switch (rec->type)
     {
-    case ANSWERS:
-      ra = rc->dns->answers;
-      ra_len = rc->dns->num_answers;
-      break;
-    case AUTHORITY_RECORDS:
-      ra = rc->dns->authority_records;
-      ra_len = rc->dns->num_authority_records;
+    case GNUNET_DNSPARSER_TYPE_A:
+      dests[i].addr_af = AF_INET;
+      GNUNET_assert (rec->data.raw.data_len == sizeof (struct in_addr));
       break;
-    case ADDITIONAL_RECORDS:
-      ra = rc->dns->additional_records;
-      ra_len = rc->dns->num_additional_records;
+    case GNUNET_DNSPARSER_TYPE_AAAA:
+      dests[i].addr_af = AF_INET6;
+      GNUNET_assert (rec->data.raw.data_len == sizeof (struct in6_addr));
       break;
-    case END:
-      finish_request (rc);
-      return;
     default:
       GNUNET_assert (0);
+      return;
     }
-    for (i=rc->offset;i<ra_len;i++)
-    {
-      switch (ra[i].type)
-      {
-      case GNUNET_DNSPARSER_TYPE_A:
-	if (ipv4_pt)
-	{
-	  rc->offset = i + 1;
-	  modify_address (rc, &ra[i]);
-	  return;
-	}
-	break;
-      case GNUNET_DNSPARSER_TYPE_AAAA:
-	if (ipv6_pt)
-	{
-	  rc->offset = i + 1;
-	  modify_address (rc, &ra[i]);
-	  return;
-	}
-	break;
-      }
-    }
-    rc->group++;
+    dests[i].result_af = dests[i].addr_af;
+    memcpy (&dests[i].addr,
+            rec->data.raw.data,
+            rec->data.raw.data_len);
+  }
+  GNUNET_STATISTICS_update (stats,
+			    gettext_noop ("# VPN redirection batches requested"),
+			    1, GNUNET_NO);
+  rc->rr = GNUNET_VPN_redirect_to_ip_batch (vpn_handle,
+                                            rc->batch_len,
+                                            dests,
+                                            GNUNET_TIME_relative_to_absolute (TIMEOUT),
+                                            &vpn_allocation_callback,
+                                            rc);
+}
+
+
+/**
+ * Test if a record needs protocol-translation work.
+ *
+ * @param rec record to check
+ * @return #GNUNET_YES if the record requires protocol-translation
+ */
+static int
+work_test (const struct GNUNET_DNSPARSER_Record *rec)
+{
+  switch (rec->type)
+  {
+  case GNUNET_DNSPARSER_TYPE_A:
+    return ipv4_pt ? GNUNET_YES : GNUNET_NO;
+  case GNUNET_DNSPARSER_TYPE_AAAA:
+    return ipv6_pt ? GNUNET_YES : GNUNET_NO;
   }
+  return GNUNET_NO;
 }
 
 
 /**
- * Test if any of the given records need protocol-translation work.
+ * Substitute the records of a section that we have a recent VPN
+ * mapping for, and collect the others in @a rc.
  *
+ * @param rc context to add records without mapping to
  * @param ra array of records
  * @param ra_len number of entries in @a ra
- * @return #GNUNET_YES if any of the given records require protocol-translation
+ * @return number of records that required protocol-translation
  */
-static int
-work_test (const struct GNUNET_DNSPARSER_Record *ra,
-	   unsigned int ra_len)
+static unsigned int
+collect_records (struct ReplyContext *rc,
+                 struct GNUNET_DNSPARSER_Record *ra,
+                 unsigned int ra_len)
 {
+  struct MappingCacheEntry *me;
+  unsigned int work;
   unsigned int i;
 
+  work = 0;
   for (i=0;i<ra_len;i++)
   {
-    switch (ra[i].type)
+    if (GNUNET_YES != work_test (&ra[i]))
+      continue;
+    work++;
+    me = lookup_mapping (&ra[i]);
+    if (NULL != me)
     {
-    case GNUNET_DNSPARSER_TYPE_A:
-      if (ipv4_pt)
-	return GNUNET_YES;
-      break;
-    case GNUNET_DNSPARSER_TYPE_AAAA:
-      if (ipv6_pt)
-	return GNUNET_YES;
-      break;
+      GNUNET_STATISTICS_update (stats,
+                                gettext_noop ("# VPN mappings reused"),
+                                1, GNUNET_NO);
+      set_address (&ra[i],
+                   me->af,
+                   &me->vpn_addr);
+      continue;
     }
+    GNUNET_array_append (rc->recs,
+                         rc->recs_len,
+                         &ra[i]);
   }
-  return GNUNET_NO;
+  return work;
 }
 
 
@@ -711,7 +844,7 @@ dns_post_request_handler (void *cls,
 {
   struct GNUNET_DNSPARSER_Packet *dns;
   struct ReplyContext *rc;
-  int work;
+  unsigned int work;
 
   GNUNET_STATISTICS_update (stats,
 			    gettext_noop ("# DNS replies intercepted"),
@@ -724,21 +857,22 @@ dns_post_request_handler (void *cls,
     GNUNET_DNS_request_drop (rh);
     return;
   }
-  work = GNUNET_NO;
-  work |= work_test (dns->answers, dns->num_answers);
-  work |= work_test (dns->authority_records, dns->num_authority_records);
-  work |= work_test (dns->additional_records, dns->num_additional_records);
-  if (! work)
+  rc = GNUNET_new (struct ReplyContext);
+  rc->rh = rh;
+  rc->dns = dns;
+  work = 0;
+  work += collect_records (rc, dns->answers, dns->num_answers);
+  work += collect_records (rc, dns->authority_records, dns->num_authority_records);
+  work += collect_records (rc, dns->additional_records, dns->num_additional_records);
+  if (0 == work)
   {
     GNUNET_DNS_request_forward (rh);
     GNUNET_DNSPARSER_free_packet (dns);
+    GNUNET_free (rc);
     return;
   }
-  rc = GNUNET_new (struct ReplyContext);
-  rc->rh = rh;
-  rc->dns = dns;
-  rc->offset = 0;
-  rc->group = ANSWERS;
+  /* all records we could not serve from the cache go to the VPN in
+     one round trip (or a few, for huge replies) */
   submit_request (rc);
 }
 
@@ -1038,6 +1172,20 @@ cleanup (void *cls,
     GNUNET_VPN_disconnect (vpn_handle);
     vpn_handle = NULL;
   }
+  if (NULL != mapping_heap)
+  {
+    struct MappingCacheEntry *me;
+
+    while (NULL != (me = GNUNET_CONTAINER_heap_peek (mapping_heap)))
+      free_mapping (me);
+    GNUNET_CONTAINER_heap_destroy (mapping_heap);
+    mapping_heap = NULL;
+  }
+  if (NULL != mapping_cache)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (mapping_cache);
+    mapping_cache = NULL;
+  }
   while (NULL != (exit = exit_head))
   {
     GNUNET_CONTAINER_DLL_remove (exit_head,
@@ -1235,6 +1383,8 @@ run (void *cls, char *const *args GNUNET_UNUSED,
      const struct GNUNET_CONFIGURATION_Handle *cfg_)
 {
   struct GNUNET_HashCode dns_key;
+  uint16_t rtypes[2];
+  unsigned int rtype_count;
 
   cfg = cfg_;
   stats = GNUNET_STATISTICS_create ("pt", cfg);
@@ -1263,6 +1413,20 @@ run (void *cls, char *const *args GNUNET_UNUSED,
       GNUNET_SCHEDULER_shutdown ();
       return;
     }
+    /* we only rewrite A and AAAA records, skip everything else */
+    rtype_count = 0;
+    if (ipv4_pt)
+      rtypes[rtype_count++] = GNUNET_DNSPARSER_TYPE_A;
+    if (ipv6_pt)
+      rtypes[rtype_count++] = GNUNET_DNSPARSER_TYPE_AAAA;
+    GNUNET_DNS_add_filter (dns_post_handle,
+                           0, NULL,
+                           0, NULL,
+                           rtype_count, rtypes,
+                           GNUNET_DNS_FILTER_FLAG_NONE);
+    mapping_cache = GNUNET_CONTAINER_multihashmap_create (MAX_MAPPING_CACHE_SIZE * 2,
+                                                          GNUNET_NO);
+    mapping_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
     vpn_handle = GNUNET_VPN_connect (cfg);
     if (NULL == vpn_handle)
     {
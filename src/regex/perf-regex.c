@@ -62,6 +62,79 @@ print_edge (void *cls,
 }
 
 
+/**
+ * Number of strings to evaluate when timing matching.
+ */
+#define EVAL_COUNT 10000
+
+
+/**
+ * Time matching random strings against @a dfa, walking the
+ * transition lists, the compiled transition table and the
+ * transition table in batches.
+ *
+ * @param dfa DFA to match against, constructed without path compression
+ */
+static void
+time_eval (struct REGEX_INTERNAL_Automaton *dfa)
+{
+  char *strings[EVAL_COUNT];
+  int results[EVAL_COUNT];
+  struct GNUNET_TIME_Absolute start;
+  unsigned int matches;
+  unsigned int i;
+
+  for (i = 0; i < EVAL_COUNT; i++)
+  {
+    char *bits = REGEX_TEST_generate_random_string (64);
+    GNUNET_asprintf (&strings[i], "GNUNET_REGEX_PROFILER_%s", bits);
+    GNUNET_free (bits);
+  }
+
+  start = GNUNET_TIME_absolute_get ();
+  matches = 0;
+  for (i = 0; i < EVAL_COUNT; i++)
+    if (0 == REGEX_INTERNAL_eval (dfa, strings[i]))
+      matches++;
+  printf ("Transition lists: %u/%u matches in %s\n",
+          matches, EVAL_COUNT,
+          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+                                                  GNUNET_NO));
+
+  if (GNUNET_OK != REGEX_INTERNAL_dfa_compile_table (dfa))
+  {
+    printf ("DFA can not be compiled into a transition table\n");
+  }
+  else
+  {
+    start = GNUNET_TIME_absolute_get ();
+    matches = 0;
+    for (i = 0; i < EVAL_COUNT; i++)
+      if (0 == REGEX_INTERNAL_eval (dfa, strings[i]))
+        matches++;
+    printf ("Transition table: %u/%u matches in %s\n",
+            matches, EVAL_COUNT,
+            GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+                                                    GNUNET_NO));
+
+    start = GNUNET_TIME_absolute_get ();
+    REGEX_INTERNAL_eval_batch (dfa, (const char *const *) strings,
+                               EVAL_COUNT, results);
+    matches = 0;
+    for (i = 0; i < EVAL_COUNT; i++)
+      if (0 == results[i])
+        matches++;
+    printf ("Transition table, batched: %u/%u matches in %s\n",
+            matches, EVAL_COUNT,
+            GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+                                                    GNUNET_NO));
+  }
+
+  for (i = 0; i < EVAL_COUNT; i++)
+    GNUNET_free (strings[i]);
+}
+
+
 /**
  * The main function of the regex performace test.
  *
@@ -76,6 +149,7 @@ int
 main (int argc, char *const *argv)
 {
   struct REGEX_INTERNAL_Automaton* dfa;
+  struct GNUNET_TIME_Absolute start;
   char **regexes;
   char *buffer;
   char *regex;
@@ -108,11 +182,21 @@ main (int argc, char *const *argv)
 	   "Combined regex (%ld bytes):\n%s\n",
 	   size,
 	   regex);
+  start = GNUNET_TIME_absolute_get ();
   dfa = REGEX_INTERNAL_construct_dfa (regex, size, compression);
+  fprintf (stderr,
+           "Constructed DFA in %s\n",
+           GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
+                                                   GNUNET_NO));
   printf ("********* ALL EDGES *********'\n");
   REGEX_INTERNAL_iterate_all_edges (dfa, &print_edge, NULL);
   printf ("\n\n********* REACHABLE EDGES *********'\n");
   REGEX_INTERNAL_iterate_reachable_edges (dfa, &print_edge, NULL);
+  if (1 == compression)
+  {
+    printf ("\n\n********* MATCHING *********'\n");
+    time_eval (dfa);
+  }
   REGEX_INTERNAL_automaton_destroy (dfa);
   GNUNET_free (buffer);
   REGEX_TEST_free_from_file (regexes);
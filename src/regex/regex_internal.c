@@ -361,77 +361,6 @@ automaton_remove_state (struct REGEX_INTERNAL_Automaton *a,
 }
 
 
-/**
- * Merge two states into one. Will merge 's1' and 's2' into 's1' and destroy
- * 's2'. 's1' will contain all (non-duplicate) outgoing transitions of 's2'.
- *
- * @param ctx context
- * @param a automaton
- * @param s1 first state
- * @param s2 second state, will be destroyed
- */
-static void
-automaton_merge_states (struct REGEX_INTERNAL_Context *ctx,
-                        struct REGEX_INTERNAL_Automaton *a,
-                        struct REGEX_INTERNAL_State *s1,
-                        struct REGEX_INTERNAL_State *s2)
-{
-  struct REGEX_INTERNAL_State *s_check;
-  struct REGEX_INTERNAL_Transition *t_check;
-  struct REGEX_INTERNAL_Transition *t;
-  struct REGEX_INTERNAL_Transition *t_next;
-  int is_dup;
-
-  if (s1 == s2)
-    return;
-
-  /* 1. Make all transitions pointing to s2 point to s1, unless this transition
-   * does not already exists, if it already exists remove transition. */
-  for (s_check = a->states_head; NULL != s_check; s_check = s_check->next)
-  {
-    for (t_check = s_check->transitions_head; NULL != t_check; t_check = t_next)
-    {
-      t_next = t_check->next;
-
-      if (s2 == t_check->to_state)
-      {
-        is_dup = GNUNET_NO;
-        for (t = t_check->from_state->transitions_head; NULL != t; t = t->next)
-        {
-          if (t->to_state == s1 && 0 == strcmp (t_check->label, t->label))
-            is_dup = GNUNET_YES;
-        }
-        if (GNUNET_NO == is_dup)
-          t_check->to_state = s1;
-        else
-          state_remove_transition (t_check->from_state, t_check);
-      }
-    }
-  }
-
-  /* 2. Add all transitions from s2 to sX to s1 */
-  for (t_check = s2->transitions_head; NULL != t_check; t_check = t_check->next)
-  {
-    if (t_check->to_state != s1)
-      state_add_transition (ctx, s1, t_check->label, t_check->to_state);
-  }
-
-  /* 3. Rename s1 to {s1,s2} */
-#if REGEX_DEBUG_DFA
-  char *new_name;
-
-  new_name = s1->name;
-  GNUNET_asprintf (&s1->name, "{%s,%s}", new_name, s2->name);
-  GNUNET_free (new_name);
-#endif
-
-  /* remove state */
-  GNUNET_CONTAINER_DLL_remove (a->states_head, a->states_tail, s2);
-  a->state_count--;
-  automaton_destroy_state (s2);
-}
-
-
 /**
  * Add a state to the automaton 'a', always use this function to alter the
  * states DLL of the automaton.
@@ -1962,7 +1891,42 @@ dfa_remove_dead_states (struct REGEX_INTERNAL_Automaton *a)
 
 
 /**
- * Merge all non distinguishable states in the DFA 'a'
+ * Get the symbol number of transition label @a label, assigning the
+ * next free number if the label was not seen before.
+ *
+ * @param symbols map from label hashes to symbol numbers plus one
+ * @param label transition label
+ * @param symbol_cnt number of symbols assigned so far, incremented
+ *        if a new number is assigned
+ * @return symbol number of @a label
+ */
+static unsigned int
+dfa_label_symbol (struct GNUNET_CONTAINER_MultiHashMap *symbols,
+                  const char *label,
+                  unsigned int *symbol_cnt)
+{
+  struct GNUNET_HashCode key;
+  uintptr_t sym;
+
+  GNUNET_CRYPTO_hash (label, strlen (label), &key);
+  sym = (uintptr_t) GNUNET_CONTAINER_multihashmap_get (symbols, &key);
+  if (0 != sym)
+    return (unsigned int) sym - 1;
+  sym = ++(*symbol_cnt);
+  GNUNET_CONTAINER_multihashmap_put (symbols, &key, (void *) sym,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+  return (unsigned int) sym - 1;
+}
+
+
+/**
+ * Merge all non distinguishable states in the DFA 'a'.
+ *
+ * Uses Hopcroft's partition refinement, which runs in O(n k log n) for
+ * n states and k distinct labels.  Missing transitions are treated as
+ * transitions to an implicit non-accepting sink state.  The transition
+ * labels have to be unique per state, which holds for a DFA before path
+ * compression.
  *
  * @param ctx context
  * @param a DFA automaton
@@ -1972,19 +1936,46 @@ static int
 dfa_merge_nondistinguishable_states (struct REGEX_INTERNAL_Context *ctx,
                                      struct REGEX_INTERNAL_Automaton *a)
 {
-  uint32_t *table;
-  struct REGEX_INTERNAL_State *s1;
-  struct REGEX_INTERNAL_State *s2;
-  struct REGEX_INTERNAL_Transition *t1;
-  struct REGEX_INTERNAL_Transition *t2;
-  struct REGEX_INTERNAL_State *s1_next;
-  struct REGEX_INTERNAL_State *s2_next;
-  int change;
-  unsigned int num_equal_edges;
+  struct GNUNET_CONTAINER_MultiHashMap *symbols;
+  struct REGEX_INTERNAL_State **states;
+  struct REGEX_INTERNAL_State *s;
+  struct REGEX_INTERNAL_State *s_next;
+  struct REGEX_INTERNAL_Transition *t;
+  unsigned int *sym_of;        /* symbol of each transition, in list order */
+  unsigned int *row;           /* targets of one state, by symbol */
+  unsigned int *inv_first;     /* per (target, symbol): start in inv_src */
+  unsigned int *inv_src;       /* sources of the inverse transitions */
+  unsigned int *elems;         /* states, grouped by block */
+  unsigned int *loc;           /* position of each state in elems */
+  unsigned int *blk;           /* block of each state */
+  unsigned int *first;         /* per block: first position in elems */
+  unsigned int *end;           /* per block: end position in elems */
+  unsigned int *marked_cnt;    /* per block: marked states at its front */
+  unsigned int *touched;       /* blocks with marked states */
+  unsigned int *scan;          /* copy of the splitter block */
+  unsigned int *work;          /* splitters, encoded as block * k + symbol */
+  uint8_t *in_work;
+  unsigned int n;
+  unsigned int k;
+  unsigned int sink;
+  unsigned int blocks;
+  unsigned int work_cnt;
+  unsigned int touched_cnt;
+  unsigned int acc_cnt;
   unsigned int i;
-  unsigned int state_cnt;
-  unsigned long long idx;
-  unsigned long long idx1;
+  unsigned int j;
+  unsigned int q;
+  unsigned int b;
+  unsigned int c;
+  unsigned int splitter;
+  unsigned int sym;
+  unsigned int pos;
+  unsigned int edges;
+  unsigned int tc;
+  unsigned int scan_cnt;
+  unsigned int pass;
+  size_t cells;
+  int ret;
 
   if ( (NULL == a) || (0 == a->state_count) )
   {
@@ -1993,87 +1984,242 @@ dfa_merge_nondistinguishable_states (struct REGEX_INTERNAL_Context *ctx,
     return GNUNET_SYSERR;
   }
 
-  state_cnt = a->state_count;
-  table = GNUNET_malloc_large ((sizeof (uint32_t) * state_cnt * state_cnt / 32)  + sizeof (uint32_t));
-  if (NULL == table)
+  /* Number the states and their labels */
+  n = a->state_count;
+  sink = n;
+  k = 0;
+  edges = 0;
+  symbols = GNUNET_CONTAINER_multihashmap_create (64, GNUNET_NO);
+  states = GNUNET_new_array (n, struct REGEX_INTERNAL_State *);
+  for (i = 0, s = a->states_head; NULL != s; s = s->next)
   {
-    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "malloc");
-    return GNUNET_SYSERR;
+    s->marked = i;
+    states[i++] = s;
+    edges += s->transition_count;
   }
+  sym_of = GNUNET_new_array (edges + 1, unsigned int);
+  for (i = 0, s = a->states_head; NULL != s; s = s->next)
+    for (t = s->transitions_head; NULL != t; t = t->next)
+      sym_of[i++] = dfa_label_symbol (symbols, t->label, &k);
+  GNUNET_CONTAINER_multihashmap_destroy (symbols);
+  if (0 == k)
+    k = 1;
 
-  for (i = 0, s1 = a->states_head; NULL != s1; s1 = s1->next)
-    s1->marked = i++;
+  cells = (size_t) (n + 1) * k;
+  if (cells >= UINT32_MAX)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Automaton too large to merge nondistinguishable states.\n");
+    GNUNET_free (sym_of);
+    GNUNET_free (states);
+    return GNUNET_SYSERR;
+  }
+  ret = GNUNET_SYSERR;
+  row = GNUNET_new_array (k, unsigned int);
+  inv_first = GNUNET_malloc_large ((cells + 1) * sizeof (unsigned int));
+  inv_src = GNUNET_malloc_large (cells * sizeof (unsigned int));
+  work = GNUNET_malloc_large (cells * sizeof (unsigned int));
+  in_work = GNUNET_malloc_large (cells);
+  elems = GNUNET_new_array (n + 1, unsigned int);
+  loc = GNUNET_new_array (n + 1, unsigned int);
+  blk = GNUNET_new_array (n + 1, unsigned int);
+  first = GNUNET_new_array (n + 1, unsigned int);
+  end = GNUNET_new_array (n + 1, unsigned int);
+  marked_cnt = GNUNET_new_array (n + 1, unsigned int);
+  touched = GNUNET_new_array (n + 1, unsigned int);
+  scan = GNUNET_new_array (n + 1, unsigned int);
+  if ( (NULL == inv_first) || (NULL == inv_src) ||
+       (NULL == work) || (NULL == in_work) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR, "malloc");
+    goto cleanup;
+  }
 
-  /* Mark all pairs of accepting/!accepting states */
-  for (s1 = a->states_head; NULL != s1; s1 = s1->next)
-    for (s2 = a->states_head; NULL != s2; s2 = s2->next)
-      if ( (s1->accepting && !s2->accepting) ||
-	   (!s1->accepting && s2->accepting) )
+  /* Build the inverse transition function of the completed DFA, first
+   * counting and then placing the sources of each (target, symbol). */
+  for (pass = 0; pass < 2; pass++)
+  {
+    if (1 == pass)
+    {
+      pos = 0;
+      for (i = 0; i <= cells; i++)
       {
-	idx = s1->marked * state_cnt + s2->marked;
-        table[idx / 32] |= (1 << (idx % 32));
+        tc = inv_first[i];
+        inv_first[i] = pos;
+        pos += tc;
       }
-
-  /* Find all equal states */
-  change = 1;
-  while (0 != change)
-  {
-    change = 0;
-    for (s1 = a->states_head; NULL != s1; s1 = s1->next)
+    }
+    else
+      memset (inv_first, 0, (cells + 1) * sizeof (unsigned int));
+    for (q = 0, j = 0; q <= n; q++)
     {
-      for (s2 = a->states_head; NULL != s2 && s1 != s2; s2 = s2->next)
+      for (sym = 0; sym < k; sym++)
+        row[sym] = sink;
+      if (q < n)
       {
-	idx = s1->marked * state_cnt + s2->marked;
-        if (0 != (table[idx / 32] & (1 << (idx % 32))))
-          continue;
-        num_equal_edges = 0;
-        for (t1 = s1->transitions_head; NULL != t1; t1 = t1->next)
-        {
-          for (t2 = s2->transitions_head; NULL != t2; t2 = t2->next)
-          {
-            if (0 == strcmp (t1->label, t2->label))
-	    {
-	      num_equal_edges++;
-	      /* same edge, but targets definitively different, so we're different
-		 as well */
-	      if (t1->to_state->marked > t2->to_state->marked)
-		idx1 = t1->to_state->marked * state_cnt + t2->to_state->marked;
-	      else
-		idx1 = t2->to_state->marked * state_cnt + t1->to_state->marked;
-	      if (0 != (table[idx1 / 32] & (1 << (idx1 % 32))))
-	      {
-		table[idx / 32] |= (1 << (idx % 32));
-		change = 1; /* changed a marker, need to run again */
-	      }
-	    }
-	  }
-        }
-        if ( (num_equal_edges != s1->transition_count) ||
-	     (num_equal_edges != s2->transition_count) )
-        {
-          /* Make sure ALL edges of possible equal states are the same */
-	  table[idx / 32] |= (1 << (idx % 32));
-	  change = 1;  /* changed a marker, need to run again */
-        }
+        for (t = states[q]->transitions_head; NULL != t; t = t->next, j++)
+          if (NULL != t->to_state)
+            row[sym_of[j]] = t->to_state->marked;
+      }
+      for (sym = 0; sym < k; sym++)
+      {
+        if (0 == pass)
+          inv_first[row[sym] * k + sym]++;
+        else
+          inv_src[inv_first[row[sym] * k + sym]++] = q;
       }
     }
   }
+  /* placing advanced each start to the next one's, shift back */
+  memmove (&inv_first[1], inv_first, cells * sizeof (unsigned int));
+  inv_first[0] = 0;
+
+  /* Initial partition: accepting states in block 0, the others and the
+   * sink in block 1 (or everything in block 0 if nothing accepts). */
+  acc_cnt = 0;
+  for (q = 0; q < n; q++)
+    if (states[q]->accepting)
+      acc_cnt++;
+  for (q = 0, i = 0, j = acc_cnt; q <= n; q++)
+  {
+    if ( (q < n) && (states[q]->accepting) )
+      pos = i++;
+    else
+      pos = j++;
+    elems[pos] = q;
+    loc[q] = pos;
+    blk[q] = ( (0 != acc_cnt) && (pos >= acc_cnt) ) ? 1 : 0;
+  }
+  if (0 == acc_cnt)
+  {
+    blocks = 1;
+    first[0] = 0;
+    end[0] = n + 1;
+  }
+  else
+  {
+    blocks = 2;
+    first[0] = 0;
+    end[0] = acc_cnt;
+    first[1] = acc_cnt;
+    end[1] = n + 1;
+  }
+  memset (in_work, 0, cells);
+  work_cnt = 0;
+  b = ( (2 == blocks) && (acc_cnt > n + 1 - acc_cnt) ) ? 1 : 0;
+  for (sym = 0; sym < k; sym++)
+  {
+    work[work_cnt++] = b * k + sym;
+    in_work[b * k + sym] = 1;
+  }
 
-  /* Merge states that are equal */
-  for (s1 = a->states_head; NULL != s1; s1 = s1_next)
+  /* Refine until no splitter is left */
+  while (0 < work_cnt)
   {
-    s1_next = s1->next;
-    for (s2 = a->states_head; NULL != s2 && s1 != s2; s2 = s2_next)
+    splitter = work[--work_cnt];
+    in_work[splitter] = 0;
+    b = splitter / k;
+    sym = splitter % k;
+
+    /* Mark all states with a 'sym' transition into block b; marking
+     * reorders the blocks, so work on a copy of b */
+    scan_cnt = end[b] - first[b];
+    memcpy (scan, &elems[first[b]], scan_cnt * sizeof (unsigned int));
+    touched_cnt = 0;
+    for (i = 0; i < scan_cnt; i++)
     {
-      s2_next = s2->next;
-      idx = s1->marked * state_cnt + s2->marked;
-      if (0 == (table[idx / 32] & (1 << (idx % 32))))
-        automaton_merge_states (ctx, a, s1, s2);
+      tc = scan[i] * k + sym;
+      for (j = inv_first[tc]; j < inv_first[tc + 1]; j++)
+      {
+        q = inv_src[j];
+        c = blk[q];
+        pos = first[c] + marked_cnt[c];
+        if (loc[q] < pos)
+          continue;             /* already marked */
+        elems[loc[q]] = elems[pos];
+        loc[elems[pos]] = loc[q];
+        elems[pos] = q;
+        loc[q] = pos;
+        if (0 == marked_cnt[c]++)
+          touched[touched_cnt++] = c;
+      }
+    }
+
+    /* Split the touched blocks into their marked and unmarked parts */
+    for (i = 0; i < touched_cnt; i++)
+    {
+      b = touched[i];
+      pos = first[b] + marked_cnt[b];
+      marked_cnt[b] = 0;
+      if (pos == end[b])
+        continue;
+      c = blocks++;
+      first[c] = first[b];
+      end[c] = pos;
+      first[b] = pos;
+      for (j = first[c]; j < end[c]; j++)
+        blk[elems[j]] = c;
+      for (sym = 0; sym < k; sym++)
+      {
+        if ( (0 == in_work[b * k + sym]) &&
+             (end[b] - first[b] < end[c] - first[c]) )
+          splitter = b * k + sym;
+        else
+          splitter = c * k + sym;
+        if (0 != in_work[splitter])
+          continue;
+        in_work[splitter] = 1;
+        work[work_cnt++] = splitter;
+      }
     }
   }
 
-  GNUNET_free (table);
-  return GNUNET_OK;
+  /* Merge each block into its first real state: redirect all transitions,
+   * then drop the other states of the block.  'touched' now holds the
+   * representative state of each block. */
+  for (b = 0; b < blocks; b++)
+  {
+    touched[b] = sink;
+    for (i = first[b]; i < end[b]; i++)
+      if (elems[i] < n)
+      {
+        touched[b] = elems[i];
+        break;
+      }
+  }
+  for (q = 0; q < n; q++)
+    for (t = states[q]->transitions_head; NULL != t; t = t->next)
+      if (NULL != t->to_state)
+        t->to_state = states[touched[blk[t->to_state->marked]]];
+  a->start = states[touched[blk[a->start->marked]]];
+  for (s = a->states_head; NULL != s; s = s_next)
+  {
+    s_next = s->next;
+    if (touched[blk[s->marked]] == (unsigned int) s->marked)
+      continue;
+    GNUNET_CONTAINER_DLL_remove (a->states_head, a->states_tail, s);
+    a->state_count--;
+    automaton_destroy_state (s);
+  }
+  ret = GNUNET_OK;
+
+cleanup:
+  GNUNET_free (scan);
+  GNUNET_free (touched);
+  GNUNET_free (marked_cnt);
+  GNUNET_free (end);
+  GNUNET_free (first);
+  GNUNET_free (blk);
+  GNUNET_free (loc);
+  GNUNET_free (elems);
+  GNUNET_free_non_null (in_work);
+  GNUNET_free_non_null (work);
+  GNUNET_free_non_null (inv_src);
+  GNUNET_free_non_null (inv_first);
+  GNUNET_free (row);
+  GNUNET_free (sym_of);
+  GNUNET_free (states);
+  return ret;
 }
 
 
@@ -2955,12 +3101,71 @@ error:
 }
 
 
+/**
+ * Compute the key of a set of NFA states in the map of DFA states.
+ * The set must be sorted by id.
+ *
+ * @param set set of NFA states
+ * @param key where to store the key
+ */
+static void
+state_set_hash (const struct REGEX_INTERNAL_StateSet *set,
+                struct GNUNET_HashCode *key)
+{
+  GNUNET_CRYPTO_hash (set->states,
+                      set->off * sizeof (struct REGEX_INTERNAL_State *),
+                      key);
+}
+
+
+/**
+ * Closure for #state_set_lookup_iterator().
+ */
+struct StateSetLookupContext
+{
+  /**
+   * Set of NFA states to look for.
+   */
+  struct REGEX_INTERNAL_StateSet *set;
+
+  /**
+   * DFA state for @e set, NULL if not found.
+   */
+  struct REGEX_INTERNAL_State *found;
+};
+
+
+/**
+ * Check if a DFA state with the same key is based on the set we look for.
+ *
+ * @param cls the `struct StateSetLookupContext`
+ * @param key key of the set
+ * @param value a `struct REGEX_INTERNAL_State`
+ * @return #GNUNET_NO if found, #GNUNET_YES to continue
+ */
+static int
+state_set_lookup_iterator (void *cls,
+                           const struct GNUNET_HashCode *key,
+                           void *value)
+{
+  struct StateSetLookupContext *lc = cls;
+  struct REGEX_INTERNAL_State *s = value;
+
+  if (0 != state_set_compare (&s->nfa_set, lc->set))
+    return GNUNET_YES;
+  lc->found = s;
+  return GNUNET_NO;
+}
+
+
 /**
  * Create DFA states based on given 'nfa' and starting with 'dfa_state'.
  *
  * @param ctx context.
  * @param nfa NFA automaton.
  * @param dfa DFA automaton.
+ * @param dfa_states DFA states created so far, by the key of the set of NFA
+ *                   states they are based on (see state_set_hash()).
  * @param dfa_state current dfa state, pass epsilon closure of first nfa state
  *                  for starting.
  */
@@ -2968,14 +3173,15 @@ static void
 construct_dfa_states (struct REGEX_INTERNAL_Context *ctx,
                       struct REGEX_INTERNAL_Automaton *nfa,
                       struct REGEX_INTERNAL_Automaton *dfa,
+                      struct GNUNET_CONTAINER_MultiHashMap *dfa_states,
                       struct REGEX_INTERNAL_State *dfa_state)
 {
   struct REGEX_INTERNAL_Transition *ctran;
   struct REGEX_INTERNAL_State *new_dfa_state;
-  struct REGEX_INTERNAL_State *state_contains;
-  struct REGEX_INTERNAL_State *state_iter;
   struct REGEX_INTERNAL_StateSet tmp;
   struct REGEX_INTERNAL_StateSet nfa_set;
+  struct StateSetLookupContext lc;
+  struct GNUNET_HashCode key;
 
   for (ctran = dfa_state->transitions_head; NULL != ctran; ctran = ctran->next)
   {
@@ -2986,26 +3192,24 @@ construct_dfa_states (struct REGEX_INTERNAL_Context *ctx,
     nfa_closure_set_create (&nfa_set, nfa, &tmp, NULL);
     state_set_clear (&tmp);
 
-    state_contains = NULL;
-    for (state_iter = dfa->states_head; NULL != state_iter;
-         state_iter = state_iter->next)
-    {
-      if (0 == state_set_compare (&state_iter->nfa_set, &nfa_set))
-      {
-        state_contains = state_iter;
-	break;
-      }
-    }
-    if (NULL == state_contains)
+    state_set_hash (&nfa_set, &key);
+    lc.set = &nfa_set;
+    lc.found = NULL;
+    GNUNET_CONTAINER_multihashmap_get_multiple (dfa_states, &key,
+                                                &state_set_lookup_iterator,
+                                                &lc);
+    if (NULL == lc.found)
     {
       new_dfa_state = dfa_state_create (ctx, &nfa_set);
       automaton_add_state (dfa, new_dfa_state);
+      GNUNET_CONTAINER_multihashmap_put (dfa_states, &key, new_dfa_state,
+                                         GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
       ctran->to_state = new_dfa_state;
-      construct_dfa_states (ctx, nfa, dfa, new_dfa_state);
+      construct_dfa_states (ctx, nfa, dfa, dfa_states, new_dfa_state);
     }
     else
     {
-      ctran->to_state = state_contains;
+      ctran->to_state = lc.found;
       state_set_clear (&nfa_set);
     }
   }
@@ -3038,6 +3242,8 @@ REGEX_INTERNAL_construct_dfa (const char *regex, const size_t len,
   struct REGEX_INTERNAL_Automaton *nfa;
   struct REGEX_INTERNAL_StateSet nfa_start_eps_cls;
   struct REGEX_INTERNAL_StateSet singleton_set;
+  struct GNUNET_CONTAINER_MultiHashMap *dfa_states;
+  struct GNUNET_HashCode key;
 
   REGEX_INTERNAL_context_init (&ctx);
 
@@ -3060,10 +3266,15 @@ REGEX_INTERNAL_construct_dfa (const char *regex, const size_t len,
   state_set_append (&singleton_set, nfa->start);
   nfa_closure_set_create (&nfa_start_eps_cls, nfa, &singleton_set, NULL);
   state_set_clear (&singleton_set);
+  state_set_hash (&nfa_start_eps_cls, &key);
   dfa->start = dfa_state_create (&ctx, &nfa_start_eps_cls);
   automaton_add_state (dfa, dfa->start);
 
-  construct_dfa_states (&ctx, nfa, dfa, dfa->start);
+  dfa_states = GNUNET_CONTAINER_multihashmap_create (1024, GNUNET_NO);
+  GNUNET_CONTAINER_multihashmap_put (dfa_states, &key, dfa->start,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  construct_dfa_states (&ctx, nfa, dfa, dfa_states, dfa->start);
+  GNUNET_CONTAINER_multihashmap_destroy (dfa_states);
   REGEX_INTERNAL_automaton_destroy (nfa);
 
   /* Minimize DFA */
@@ -3088,6 +3299,22 @@ REGEX_INTERNAL_construct_dfa (const char *regex, const size_t len,
 }
 
 
+/**
+ * Free the transition table of a DFA.
+ *
+ * @param table table to free
+ */
+static void
+table_destroy (struct REGEX_INTERNAL_Table *table)
+{
+  if (NULL == table)
+    return;
+  GNUNET_free (table->next);
+  GNUNET_free (table->accepting);
+  GNUNET_free (table);
+}
+
+
 /**
  * Free the memory allocated by constructing the REGEX_INTERNAL_Automaton data
  * structure.
@@ -3105,6 +3332,7 @@ REGEX_INTERNAL_automaton_destroy (struct REGEX_INTERNAL_Automaton *a)
 
   GNUNET_free_non_null (a->regex);
   GNUNET_free_non_null (a->canonical_regex);
+  table_destroy (a->table);
 
   for (s = a->states_head; NULL != s; s = next_state)
   {
@@ -3117,6 +3345,210 @@ REGEX_INTERNAL_automaton_destroy (struct REGEX_INTERNAL_Automaton *a)
 }
 
 
+/**
+ * Entry used to split byte classes, see #table_refine_classes().
+ */
+struct ByteClassEntry
+{
+  uint32_t cls;
+  uint32_t target;
+  unsigned int byte;
+};
+
+
+/**
+ * Compare two byte class entries by class, then by target state.
+ */
+static int
+byte_class_entry_cmp (const void *a, const void *b)
+{
+  const struct ByteClassEntry *x = a;
+  const struct ByteClassEntry *y = b;
+
+  if (x->cls != y->cls)
+    return (x->cls < y->cls) ? -1 : 1;
+  if (x->target != y->target)
+    return (x->target < y->target) ? -1 : 1;
+  return 0;
+}
+
+
+/**
+ * Fill @a row with the target state index of each byte in state @a s.
+ * States must be numbered in their 'marked' field.
+ *
+ * @param s state
+ * @param row array of 256 targets to fill
+ * @return #GNUNET_OK on success, #GNUNET_NO if @a s has compressed
+ *         transitions that can not be expressed byte by byte
+ */
+static int
+table_row (const struct REGEX_INTERNAL_State *s, uint32_t *row)
+{
+  const struct REGEX_INTERNAL_Transition *t;
+  unsigned int b;
+
+  for (b = 0; b < 256; b++)
+    row[b] = REGEX_INTERNAL_TABLE_DEAD;
+  for (t = s->transitions_head; NULL != t; t = t->next)
+    if (NULL != t->to_state && NULL != t->label && 1 == strlen (t->label))
+      row[(unsigned char) t->label[0]] = t->to_state->marked;
+  /* Multi-strided transitions are shortcuts for single-byte transitions,
+   * while compressed paths replace them. */
+  for (t = s->transitions_head; NULL != t; t = t->next)
+    if (NULL != t->to_state && NULL != t->label && 1 < strlen (t->label)
+        && REGEX_INTERNAL_TABLE_DEAD == row[(unsigned char) t->label[0]])
+      return GNUNET_NO;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Split the byte classes in @a byte_class, so that bytes in the same class
+ * lead to the same state from state @a row as well.
+ *
+ * @param byte_class class of each byte, updated
+ * @param class_count number of classes, updated
+ * @param row target state of each byte
+ */
+static void
+table_refine_classes (uint32_t *byte_class, unsigned int *class_count,
+                      const uint32_t *row)
+{
+  struct ByteClassEntry e[256];
+  unsigned int b;
+  unsigned int count;
+
+  for (b = 0; b < 256; b++)
+  {
+    e[b].cls = byte_class[b];
+    e[b].target = row[b];
+    e[b].byte = b;
+  }
+  qsort (e, 256, sizeof (e[0]), &byte_class_entry_cmp);
+  count = 0;
+  for (b = 0; b < 256; b++)
+  {
+    if (0 == b || 0 != byte_class_entry_cmp (&e[b], &e[b - 1]))
+      count++;
+    byte_class[e[b].byte] = count - 1;
+  }
+  *class_count = count;
+}
+
+
+/**
+ * Compile the DFA @a a into a dense transition table, that is then used by
+ * #REGEX_INTERNAL_eval() and #REGEX_INTERNAL_eval_batch().  Bytes that lead
+ * to the same state from every state are merged into one byte class, so a
+ * row of the table only has one column per class.
+ *
+ * DFAs with compressed paths (constructed with a 'max_path_len' other
+ * than 1) can not be compiled.
+ *
+ * @param a DFA
+ * @return #GNUNET_OK on success, #GNUNET_NO if @a a can not be compiled
+ */
+int
+REGEX_INTERNAL_dfa_compile_table (struct REGEX_INTERNAL_Automaton *a)
+{
+  struct REGEX_INTERNAL_Table *table;
+  struct REGEX_INTERNAL_State *s;
+  uint32_t byte_class[256];
+  uint32_t row[256];
+  unsigned int class_count;
+  unsigned int state_count;
+  unsigned int b;
+  int ret;
+
+  if (NULL != a->table)
+    return GNUNET_OK;
+  if (DFA != a->type || NULL == a->start)
+    return GNUNET_NO;
+
+  state_count = 0;
+  for (s = a->states_head; NULL != s; s = s->next)
+    s->marked = state_count++;
+
+  /* Compute byte classes */
+  ret = GNUNET_OK;
+  memset (byte_class, 0, sizeof (byte_class));
+  class_count = 1;
+  for (s = a->states_head; NULL != s && GNUNET_OK == ret; s = s->next)
+  {
+    ret = table_row (s, row);
+    table_refine_classes (byte_class, &class_count, row);
+  }
+  if (GNUNET_OK != ret)
+  {
+    for (s = a->states_head; NULL != s; s = s->next)
+      s->marked = GNUNET_NO;
+    return GNUNET_NO;
+  }
+
+  /* Fill the table */
+  table = GNUNET_new (struct REGEX_INTERNAL_Table);
+  for (b = 0; b < 256; b++)
+    table->byte_class[b] = byte_class[b];
+  table->class_count = class_count;
+  table->state_count = state_count;
+  table->start = a->start->marked;
+  table->next = GNUNET_malloc_large ((size_t) state_count * class_count
+                                     * sizeof (uint32_t));
+  table->accepting = GNUNET_malloc (state_count);
+  if (NULL == table->next)
+  {
+    GNUNET_free (table->accepting);
+    GNUNET_free (table);
+    ret = GNUNET_NO;
+  }
+  else
+  {
+    for (s = a->states_head; NULL != s; s = s->next)
+    {
+      table_row (s, row);
+      for (b = 0; b < 256; b++)
+        table->next[(size_t) s->marked * class_count + byte_class[b]] = row[b];
+      table->accepting[s->marked] = s->accepting ? GNUNET_YES : GNUNET_NO;
+    }
+    a->table = table;
+  }
+
+  for (s = a->states_head; NULL != s; s = s->next)
+    s->marked = GNUNET_NO;
+  if (NULL != a->table)
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Compiled DFA with %u states into table with %u byte classes\n",
+                state_count, class_count);
+  return ret;
+}
+
+
+/**
+ * Evaluates the given string using the transition table of a DFA.
+ *
+ * @param table compiled DFA
+ * @param string string that should be evaluated
+ * @return 0 if string matches, non-0 otherwise
+ */
+static int
+evaluate_table (const struct REGEX_INTERNAL_Table *table,
+                const char *string)
+{
+  const unsigned char *strp;
+  uint32_t s = table->start;
+
+  for (strp = (const unsigned char *) string; NULL != strp && *strp; strp++)
+  {
+    s = table->next[(size_t) s * table->class_count
+                    + table->byte_class[*strp]];
+    if (REGEX_INTERNAL_TABLE_DEAD == s)
+      return 1;
+  }
+  return table->accepting[s] ? 0 : 1;
+}
+
+
 /**
  * Evaluates the given string using the given DFA automaton
  *
@@ -3140,6 +3572,9 @@ evaluate_dfa (struct REGEX_INTERNAL_Automaton *a,
     return -1;
   }
 
+  if (NULL != a->table)
+    return evaluate_table (a->table, string);
+
   s = a->start;
 
   /* If the string is empty but the starting state is accepting, we accept. */
@@ -3254,6 +3689,83 @@ REGEX_INTERNAL_eval (struct REGEX_INTERNAL_Automaton *a,
   return result;
 }
 
+/**
+ * Evaluates @a count strings against the given compiled regex @a a.
+ *
+ * If @a a is a DFA that can be compiled into a transition table (see
+ * #REGEX_INTERNAL_dfa_compile_table()), several strings are walked through
+ * the table in lock-step, so the table lookups of different strings overlap
+ * instead of each waiting for the previous one.
+ *
+ * @param a automaton
+ * @param strings strings to check
+ * @param count number of @a strings
+ * @param results where to store the result for each string:
+ *        0 if it matches, non-0 otherwise
+ */
+void
+REGEX_INTERNAL_eval_batch (struct REGEX_INTERNAL_Automaton *a,
+                           const char *const *strings,
+                           unsigned int count,
+                           int *results)
+{
+  const struct REGEX_INTERNAL_Table *table;
+  const unsigned char *strp[REGEX_INTERNAL_EVAL_BATCH_WIDTH];
+  uint32_t s[REGEX_INTERNAL_EVAL_BATCH_WIDTH];
+  unsigned int base;
+  unsigned int active;
+  unsigned int n;
+  unsigned int i;
+
+  if ( (DFA != a->type) ||
+       (GNUNET_OK != REGEX_INTERNAL_dfa_compile_table (a)) )
+  {
+    for (i = 0; i < count; i++)
+      results[i] = REGEX_INTERNAL_eval (a, strings[i]);
+    return;
+  }
+  table = a->table;
+
+  for (base = 0; base < count; base += REGEX_INTERNAL_EVAL_BATCH_WIDTH)
+  {
+    n = GNUNET_MIN (count - base, REGEX_INTERNAL_EVAL_BATCH_WIDTH);
+    for (i = 0; i < n; i++)
+    {
+      strp[i] = (NULL != strings[base + i])
+        ? (const unsigned char *) strings[base + i]
+        : (const unsigned char *) "";
+      s[i] = table->start;
+    }
+    active = n;
+    while (0 < active)
+    {
+      active = 0;
+      for (i = 0; i < n; i++)
+      {
+        if (NULL == strp[i])
+          continue;
+        if ('\0' == *strp[i])
+        {
+          results[base + i] = table->accepting[s[i]] ? 0 : 1;
+          strp[i] = NULL;
+          continue;
+        }
+        s[i] = table->next[(size_t) s[i] * table->class_count
+                           + table->byte_class[*strp[i]]];
+        if (REGEX_INTERNAL_TABLE_DEAD == s[i])
+        {
+          results[base + i] = 1;
+          strp[i] = NULL;
+          continue;
+        }
+        strp[i]++;
+        active++;
+      }
+    }
+  }
+}
+
+
 
 /**
  * Get the canonical regex of the given automaton.
@@ -242,6 +242,52 @@ struct REGEX_INTERNAL_State
 };
 
 
+/**
+ * Marks a missing transition in a #REGEX_INTERNAL_Table.
+ */
+#define REGEX_INTERNAL_TABLE_DEAD UINT32_MAX
+
+
+/**
+ * DFA compiled into a dense transition table,
+ * see REGEX_INTERNAL_dfa_compile_table().
+ */
+struct REGEX_INTERNAL_Table
+{
+  /**
+   * Byte class of each input byte.  Bytes that lead to the same
+   * state from every state share a class.
+   */
+  uint8_t byte_class[256];
+
+  /**
+   * Number of byte classes.
+   */
+  unsigned int class_count;
+
+  /**
+   * Number of states.
+   */
+  unsigned int state_count;
+
+  /**
+   * Index of the start state.
+   */
+  uint32_t start;
+
+  /**
+   * Transitions: the next state for state 's' and byte class 'c' is at
+   * 's * class_count + c', #REGEX_INTERNAL_TABLE_DEAD if there is none.
+   */
+  uint32_t *next;
+
+  /**
+   * Non-zero for accepting states.
+   */
+  uint8_t *accepting;
+};
+
+
 /**
  * Type of an automaton.
  */
@@ -312,6 +358,11 @@ struct REGEX_INTERNAL_Automaton
    * GNUNET_YES, if multi strides have been added to the Automaton.
    */
   int is_multistrided;
+
+  /**
+   * Transition table, NULL if the DFA was not compiled.
+   */
+  struct REGEX_INTERNAL_Table *table;
 };
 
 
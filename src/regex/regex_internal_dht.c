@@ -50,6 +50,38 @@
 #define DHT_OPT         GNUNET_DHT_RO_DEMULTIPLEX_EVERYWHERE
 
 
+/**
+ * Automaton shared by all announcements of the same regex with the
+ * same compression.
+ */
+struct CachedAutomaton
+{
+  /**
+   * Key in #automaton_cache, hash over regex and compression.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * The automaton.
+   */
+  struct REGEX_INTERNAL_Automaton *dfa;
+
+  /**
+   * Number of announcements using @e dfa.
+   */
+  unsigned int rc;
+};
+
+
+/**
+ * Automata of active announcements, by hash over regex and compression,
+ * values are of type `struct CachedAutomaton`.  Building the automaton
+ * of a large policy is expensive, so announcements of the same policy
+ * share it.  NULL while there are no announcements.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *automaton_cache;
+
+
 /**
  * Handle to store cached data about a regex announce.
  */
@@ -70,6 +102,11 @@ struct REGEX_INTERNAL_Announcement
    */
   struct REGEX_INTERNAL_Automaton *dfa;
 
+  /**
+   * Cache entry holding @e dfa, NULL if it could not be built.
+   */
+  struct CachedAutomaton *cached;
+
   /**
    * Our private key.
    */
@@ -177,6 +214,86 @@ regex_iterator (void *cls,
 }
 
 
+/**
+ * Get the automaton for @a regex with @a compression, building it
+ * unless another announcement already did.
+ *
+ * @param regex regular expression
+ * @param compression how many characters per edge
+ * @return cache entry with a reference for the caller, NULL if the
+ *         automaton could not be built
+ */
+static struct CachedAutomaton *
+automaton_cache_get (const char *regex,
+                     uint16_t compression)
+{
+  struct GNUNET_HashContext *hc;
+  struct GNUNET_HashCode key;
+  struct CachedAutomaton *ca;
+  uint16_t compression_nbo;
+
+  compression_nbo = htons (compression);
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc, &compression_nbo,
+                                   sizeof (compression_nbo));
+  GNUNET_CRYPTO_hash_context_read (hc, regex, strlen (regex));
+  GNUNET_CRYPTO_hash_context_finish (hc, &key);
+  if (NULL == automaton_cache)
+    automaton_cache = GNUNET_CONTAINER_multihashmap_create (4, GNUNET_NO);
+  ca = GNUNET_CONTAINER_multihashmap_get (automaton_cache, &key);
+  if (NULL != ca)
+  {
+    ca->rc++;
+    return ca;
+  }
+  ca = GNUNET_new (struct CachedAutomaton);
+  ca->key = key;
+  ca->rc = 1;
+  ca->dfa = REGEX_INTERNAL_construct_dfa (regex, strlen (regex), compression);
+  if (NULL == ca->dfa)
+  {
+    GNUNET_free (ca);
+    ca = NULL;
+  }
+  else
+  {
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (automaton_cache, &key, ca,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  if (0 == GNUNET_CONTAINER_multihashmap_size (automaton_cache))
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (automaton_cache);
+    automaton_cache = NULL;
+  }
+  return ca;
+}
+
+
+/**
+ * Release a reference to a cached automaton, destroying it with the
+ * last reference.
+ *
+ * @param ca cache entry to release
+ */
+static void
+automaton_cache_release (struct CachedAutomaton *ca)
+{
+  if (0 < --ca->rc)
+    return;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (automaton_cache,
+                                                       &ca->key, ca));
+  REGEX_INTERNAL_automaton_destroy (ca->dfa);
+  GNUNET_free (ca);
+  if (0 == GNUNET_CONTAINER_multihashmap_size (automaton_cache))
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (automaton_cache);
+    automaton_cache = NULL;
+  }
+}
+
+
 /**
  * Announce a regular expression: put all states of the automaton in the DHT.
  * Does not free resources, must call #REGEX_INTERNAL_announce_cancel() for that.
@@ -204,7 +321,9 @@ REGEX_INTERNAL_announce (struct GNUNET_DHT_Handle *dht,
   h->dht = dht;
   h->stats = stats;
   h->priv = priv;
-  h->dfa = REGEX_INTERNAL_construct_dfa (regex, strlen (regex), compression);
+  h->cached = automaton_cache_get (regex, compression);
+  if (NULL != h->cached)
+    h->dfa = h->cached->dfa;
   REGEX_INTERNAL_reannounce (h);
   return h;
 }
@@ -238,7 +357,8 @@ REGEX_INTERNAL_reannounce (struct REGEX_INTERNAL_Announcement *h)
 void
 REGEX_INTERNAL_announce_cancel (struct REGEX_INTERNAL_Announcement *h)
 {
-  REGEX_INTERNAL_automaton_destroy (h->dfa);
+  if (NULL != h->cached)
+    automaton_cache_release (h->cached);
   GNUNET_free (h);
 }
 
@@ -246,12 +366,36 @@ REGEX_INTERNAL_announce_cancel (struct REGEX_INTERNAL_Announcement *h)
 /******************************************************************************/
 
 
+/**
+ * Maximum number of search branches per search that wait for their
+ * first DHT result.  Further branches are queued until one of them
+ * got a result.
+ */
+#define REGEX_SEARCH_MAX_FRONTIER 16
+
+/**
+ * Maximum number of regex blocks cached for all searches.
+ */
+#define REGEX_BLOCK_CACHE_SIZE 1024
+
+
 /**
  * Struct to keep state of running searches that have consumed a part of
- * the inital string.
+ * the inital string.  There is one such branch for each combination of
+ * state and position in the string reached by the search.
  */
 struct RegexSearchContext
 {
+  /**
+   * Kept in a DLL while queued for the frontier.
+   */
+  struct RegexSearchContext *next;
+
+  /**
+   * Kept in a DLL while queued for the frontier.
+   */
+  struct RegexSearchContext *prev;
+
   /**
    * Part of the description already consumed by
    * this particular search branch.
@@ -264,35 +408,69 @@ struct RegexSearchContext
   struct REGEX_INTERNAL_Search *info;
 
   /**
-   * We just want to look for one edge, the longer the better.
-   * Keep its length.
+   * Key of the state this branch is looking at.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * DHT GET for the state, NULL if not (yet) running.
    */
-  unsigned int longest_match;
+  struct GNUNET_DHT_GetHandle *get;
 
   /**
-   * Destination hash of the longest match.
+   * #GNUNET_YES if we got a block for the state, #GNUNET_NO while the
+   * branch is part of the frontier or queued for it.
    */
-  struct GNUNET_HashCode hash;
+  int have_block;
 };
 
 
 /**
- * Type of values in `dht_get_results`.
+ * Block cached for all searches.
  */
-struct Result
+struct CachedBlock
 {
   /**
-   * Number of bytes in data.
+   * Key of the state.
    */
-  size_t size;
+  struct GNUNET_HashCode key;
+
+  /**
+   * Entry in #block_cache_heap, by expiration time.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
 
   /**
-   * The raw result data.
+   * When does the block expire?
    */
-  const void *data;
+  struct GNUNET_TIME_Absolute expiration;
+
+  /**
+   * Number of bytes in the block, which follows this struct.
+   */
+  size_t size;
 };
 
 
+/**
+ * Blocks found by the DHT GETs of all searches, by key of the state,
+ * values are of type `struct CachedBlock`.  Lets concurrent searches
+ * for similar strings skip the DHT for states another search already
+ * found.  NULL while there are no searches.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *block_cache;
+
+/**
+ * The entries of #block_cache, by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *block_cache_heap;
+
+/**
+ * Number of running searches.
+ */
+static unsigned int search_count;
+
+
 /**
  * Struct to keep information of searches of services described by a regex
  * using a user-provided string service description.
@@ -315,15 +493,20 @@ struct REGEX_INTERNAL_Search
   char *description;
 
   /**
-   * Running DHT GETs.
+   * Length of @e description.
+   */
+  size_t description_len;
+
+  /**
+   * Search branches by hash over state key and position, used to
+   * follow each of them only once.
    */
-  struct GNUNET_CONTAINER_MultiHashMap *dht_get_handles;
+  struct GNUNET_CONTAINER_MultiHashMap *branches;
 
   /**
-   * Results from running DHT GETs, values are of type
-   * 'struct Result'.
+   * Running DHT GETs for accepting states.
    */
-  struct GNUNET_CONTAINER_MultiHashMap *dht_get_results;
+  struct GNUNET_CONTAINER_MultiHashMap *accept_handles;
 
   /**
    * Contexts, for each running DHT GET. Free all on end of search.
@@ -335,6 +518,32 @@ struct REGEX_INTERNAL_Search
    */
   unsigned int n_contexts;
 
+  /**
+   * Head of branches waiting to enter the frontier.
+   */
+  struct RegexSearchContext *queue_head;
+
+  /**
+   * Tail of branches waiting to enter the frontier.
+   */
+  struct RegexSearchContext *queue_tail;
+
+  /**
+   * Number of branches with a running GET but no block yet.
+   */
+  unsigned int frontier;
+
+  /**
+   * #GNUNET_YES once an accepting state was found for the whole
+   * description; no further branches are expanded then.
+   */
+  int accepted;
+
+  /**
+   * Task to stop the branches after an accepting state was found.
+   */
+  struct GNUNET_SCHEDULER_Task *prune_task;
+
   /**
    * @param callback Callback for found peers.
    */
@@ -348,7 +557,7 @@ struct REGEX_INTERNAL_Search
 
 
 /**
- * Jump to the next edge, with the longest matching token.
+ * Jump to the next edges matching the rest of the description.
  *
  * @param block Block found in the DHT.
  * @param size Size of the block.
@@ -360,6 +569,22 @@ regex_next_edge (const struct RegexBlock *block,
                  struct RegexSearchContext *ctx);
 
 
+/**
+ * Add a block to the cache shared by all searches, unless it is
+ * already there.
+ *
+ * @param key key of the state
+ * @param expiration when the block expires
+ * @param size number of bytes in @a block
+ * @param block the block
+ */
+static void
+block_cache_add (const struct GNUNET_HashCode *key,
+                 struct GNUNET_TIME_Absolute expiration,
+                 size_t size,
+                 const void *block);
+
+
 /**
  * Function to process DHT string to regex matching.
  * Called on each result obtained for the DHT search.
@@ -406,9 +631,45 @@ dht_get_string_accept_handler (void *cls, struct GNUNET_TIME_Absolute exp,
 }
 
 
+/**
+ * Stop all branches of a search that found an accepting state.
+ *
+ * @param cls the `struct REGEX_INTERNAL_Search`
+ * @param tc scheduler context
+ */
+static void
+prune_branches (void *cls,
+                const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct REGEX_INTERNAL_Search *info = cls;
+  struct RegexSearchContext *ctx;
+  unsigned int i;
+
+  info->prune_task = NULL;
+  for (i = 0; i < info->n_contexts; i++)
+  {
+    ctx = info->contexts[i];
+    if (NULL == ctx->get)
+      continue;
+    GNUNET_DHT_get_stop (ctx->get);
+    ctx->get = NULL;
+    GNUNET_STATISTICS_update (info->stats, "# regex branches pruned",
+                              1, GNUNET_NO);
+  }
+  while (NULL != (ctx = info->queue_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (info->queue_head, info->queue_tail, ctx);
+    GNUNET_STATISTICS_update (info->stats, "# regex branches pruned",
+                              1, GNUNET_NO);
+  }
+  info->frontier = 0;
+}
+
+
 /**
  * Find a path to a peer that offers a regex service compatible
- * with a given string.
+ * with a given string.  As the string was matched, stop expanding
+ * the other branches of the search.
  *
  * @param key The key of the accepting state.
  * @param ctx Context containing info about the string, tunnel, etc.
@@ -417,13 +678,17 @@ static void
 regex_find_path (const struct GNUNET_HashCode *key,
                  struct RegexSearchContext *ctx)
 {
+  struct REGEX_INTERNAL_Search *info = ctx->info;
   struct GNUNET_DHT_GetHandle *get_h;
 
+  if (GNUNET_YES ==
+      GNUNET_CONTAINER_multihashmap_contains (info->accept_handles, key))
+    return;
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Accept state found, now searching for paths to %s\n",
        GNUNET_h2s (key),
        (unsigned int) ctx->position);
-  get_h = GNUNET_DHT_get_start (ctx->info->dht,    /* handle */
+  get_h = GNUNET_DHT_get_start (info->dht,    /* handle */
                                 GNUNET_BLOCK_TYPE_REGEX_ACCEPT, /* type */
                                 key,     /* key to search */
                                 DHT_REPLICATION, /* replication level */
@@ -432,10 +697,87 @@ regex_find_path (const struct GNUNET_HashCode *key,
                                 0,     /* xquery bits */ // FIXME BLOOMFILTER SIZE
                                 &dht_get_string_accept_handler, ctx);
   GNUNET_break (GNUNET_OK ==
-                GNUNET_CONTAINER_multihashmap_put(ctx->info->dht_get_handles,
-                                                  key,
-                                                  get_h,
-                                                  GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+                GNUNET_CONTAINER_multihashmap_put (info->accept_handles,
+                                                   key,
+                                                   get_h,
+                                                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  if (GNUNET_YES == info->accepted)
+    return;
+  /* we may be called from a DHT result handler, stop the GETs later */
+  info->accepted = GNUNET_YES;
+  info->prune_task = GNUNET_SCHEDULER_add_now (&prune_branches, info);
+}
+
+
+/**
+ * Process a regex block for the state of a search branch.
+ *
+ * @param ctx the search branch
+ * @param key key of the state
+ * @param block the block
+ * @param size number of bytes in @a block
+ */
+static void
+regex_process_block (struct RegexSearchContext *ctx,
+                     const struct GNUNET_HashCode *key,
+                     const struct RegexBlock *block,
+                     size_t size)
+{
+  struct REGEX_INTERNAL_Search *info = ctx->info;
+
+  if (ctx->position == info->description_len) // String processed
+  {
+    if (GNUNET_YES == GNUNET_BLOCK_is_accepting (block, size))
+    {
+      regex_find_path (key, ctx);
+    }
+    else
+    {
+      LOG (GNUNET_ERROR_TYPE_INFO, "block not accepting!\n");
+      /* FIXME REGEX this block not successful, wait for more? start timeout? */
+    }
+    return;
+  }
+  if (GNUNET_YES == info->accepted)
+    return;
+  regex_next_edge (block, size, ctx);
+}
+
+
+/**
+ * Start the DHT GET for a branch that entered the frontier.
+ *
+ * @param ctx the search branch
+ */
+static void
+branch_start (struct RegexSearchContext *ctx);
+
+
+/**
+ * A branch got its first block, let queued branches take its place
+ * in the frontier.
+ *
+ * @param ctx the search branch
+ */
+static void
+branch_got_block (struct RegexSearchContext *ctx)
+{
+  struct REGEX_INTERNAL_Search *info = ctx->info;
+  struct RegexSearchContext *next;
+
+  if (GNUNET_YES == ctx->have_block)
+    return;
+  ctx->have_block = GNUNET_YES;
+  if (NULL == ctx->get)
+    return;
+  info->frontier--;
+  while ( (GNUNET_NO == info->accepted) &&
+          (info->frontier < REGEX_SEARCH_MAX_FRONTIER) &&
+          (NULL != (next = info->queue_head)) )
+  {
+    GNUNET_CONTAINER_DLL_remove (info->queue_head, info->queue_tail, next);
+    branch_start (next);
+  }
 }
 
 
@@ -468,45 +810,22 @@ dht_get_string_handler (void *cls, struct GNUNET_TIME_Absolute exp,
 {
   const struct RegexBlock *block = data;
   struct RegexSearchContext *ctx = cls;
-  struct REGEX_INTERNAL_Search *info = ctx->info;
-  size_t len;
-  struct Result *copy;
 
   LOG (GNUNET_ERROR_TYPE_INFO,
        "DHT GET result for %s (%s)\n",
        GNUNET_h2s (key), ctx->info->description);
-  copy = GNUNET_malloc (sizeof (struct Result) + size);
-  copy->size = size;
-  copy->data = &copy[1];
-  memcpy (&copy[1], block, size);
-  GNUNET_break (GNUNET_OK ==
-		GNUNET_CONTAINER_multihashmap_put (info->dht_get_results,
-						   key, copy,
-						   GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
-  len = strlen (info->description);
-  if (len == ctx->position) // String processed
-  {
-    if (GNUNET_YES == GNUNET_BLOCK_is_accepting (block, size))
-    {
-      regex_find_path (key, ctx);
-    }
-    else
-    {
-      LOG (GNUNET_ERROR_TYPE_INFO, "block not accepting!\n");
-      /* FIXME REGEX this block not successful, wait for more? start timeout? */
-    }
-    return;
-  }
-  regex_next_edge (block, size, ctx);
+  block_cache_add (key, exp, size, block);
+  branch_got_block (ctx);
+  regex_process_block (ctx, key, block, size);
 }
 
 
 /**
- * Iterator over found existing cadet regex blocks that match an ongoing search.
+ * Iterator over cached regex blocks that match an ongoing search.
  *
  * @param cls Closure (current context)-
  * @param key Current key code (key for cached block).
- * @param value Value in the hash map (cached RegexBlock).
+ * @param value Value in the hash map (`struct CachedBlock`).
  * @return #GNUNET_YES: we should always continue to iterate.
  */
 static int
@@ -514,37 +833,148 @@ regex_result_iterator (void *cls,
                        const struct GNUNET_HashCode * key,
                        void *value)
 {
-  struct Result *result = value;
-  const struct RegexBlock *block = result->data;
+  struct CachedBlock *cb = value;
   struct RegexSearchContext *ctx = cls;
 
-  if ( (GNUNET_YES ==
-	GNUNET_BLOCK_is_accepting (block, result->size)) &&
-       (ctx->position == strlen (ctx->info->description)) )
-  {
-    LOG (GNUNET_ERROR_TYPE_INFO,
-	 "Found accepting known block\n");
-    regex_find_path (key, ctx);
-    return GNUNET_YES; // We found an accept state!
-  }
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "* %u, %u, [%u]\n",
-       ctx->position,
-       strlen (ctx->info->description),
-       GNUNET_BLOCK_is_accepting (block, result->size));
-  regex_next_edge (block, result->size, ctx);
+  if (0 == GNUNET_TIME_absolute_get_remaining (cb->expiration).rel_value_us)
+    return GNUNET_YES;
+  GNUNET_STATISTICS_update (ctx->info->stats, "# regex cached blocks used",
+                            1, GNUNET_NO);
+  branch_got_block (ctx);
+  regex_process_block (ctx, key,
+                       (const struct RegexBlock *) &cb[1], cb->size);
+  return GNUNET_YES;
+}
 
-  GNUNET_STATISTICS_update (ctx->info->stats, "# regex cadet blocks iterated",
+
+static void
+branch_start (struct RegexSearchContext *ctx)
+{
+  struct REGEX_INTERNAL_Search *info = ctx->info;
+  const char *rest;
+
+  GNUNET_STATISTICS_update (info->stats, "# regex nodes traversed",
                             1, GNUNET_NO);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Following edges at %s for offset %u in `%s'\n",
+       GNUNET_h2s (&ctx->key),
+       (unsigned int) ctx->position,
+       info->description);
+  rest = &info->description[ctx->position];
+  ctx->get =
+      GNUNET_DHT_get_start (info->dht,    /* handle */
+                            GNUNET_BLOCK_TYPE_REGEX, /* type */
+                            &ctx->key,     /* key to search */
+                            DHT_REPLICATION, /* replication level */
+                            DHT_OPT,
+                            rest, /* xquery */
+                            // FIXME add BLOOMFILTER to exclude filtered peers
+                            strlen (rest) + 1,     /* xquery bits */
+                            // FIXME add BLOOMFILTER SIZE
+                            &dht_get_string_handler, ctx);
+  info->frontier++;
+  /* Another search may already have found the state */
+  if (NULL != block_cache)
+    GNUNET_CONTAINER_multihashmap_get_multiple (block_cache,
+                                                &ctx->key,
+                                                &regex_result_iterator,
+                                                ctx);
+}
 
-  return GNUNET_YES;
+
+/**
+ * Add a branch for state @a key at @a position to a search, unless
+ * the search already has it.
+ *
+ * @param info the search
+ * @param key key of the state
+ * @param position number of characters of the description consumed
+ */
+static void
+branch_add (struct REGEX_INTERNAL_Search *info,
+            const struct GNUNET_HashCode *key,
+            size_t position)
+{
+  struct RegexSearchContext *ctx;
+  struct GNUNET_HashContext *hc;
+  struct GNUNET_HashCode branch_key;
+  uint64_t position_nbo;
+
+  position_nbo = GNUNET_htonll ((uint64_t) position);
+  hc = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hc, key, sizeof (struct GNUNET_HashCode));
+  GNUNET_CRYPTO_hash_context_read (hc, &position_nbo, sizeof (position_nbo));
+  GNUNET_CRYPTO_hash_context_finish (hc, &branch_key);
+  if (GNUNET_YES ==
+      GNUNET_CONTAINER_multihashmap_contains (info->branches, &branch_key))
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+	 "Branch for %s at offset %u exists, END\n",
+         GNUNET_h2s (key),
+         (unsigned int) position);
+    GNUNET_STATISTICS_update (info->stats, "# regex duplicate branches",
+                              1, GNUNET_NO);
+    return;
+  }
+  ctx = GNUNET_new (struct RegexSearchContext);
+  ctx->info = info;
+  ctx->key = *key;
+  ctx->position = position;
+  GNUNET_array_append (info->contexts, info->n_contexts, ctx);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (info->branches,
+                                                    &branch_key, ctx,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  if (info->frontier < REGEX_SEARCH_MAX_FRONTIER)
+    branch_start (ctx);
+  else
+    GNUNET_CONTAINER_DLL_insert_tail (info->queue_head, info->queue_tail, ctx);
 }
 
 
+/**
+ * Edge of a block matching the rest of the description.
+ */
+struct EdgeMatch
+{
+  /**
+   * Length of the token.
+   */
+  size_t len;
+
+  /**
+   * Destination of the edge.
+   */
+  struct GNUNET_HashCode key;
+};
+
+
+/**
+ * Closure for #regex_edge_iterator().
+ */
+struct EdgeMatchContext
+{
+  /**
+   * Search branch the block belongs to.
+   */
+  struct RegexSearchContext *ctx;
+
+  /**
+   * Matching edges found so far.
+   */
+  struct EdgeMatch *matches;
+
+  /**
+   * Number of entries in @e matches.
+   */
+  unsigned int n_matches;
+};
+
+
 /**
  * Iterator over edges in a regex block retrieved from the DHT.
  *
- * @param cls Closure (context of the search).
+ * @param cls Closure (`struct EdgeMatchContext`).
  * @param token Token that follows to next state.
  * @param len Lenght of token.
  * @param key Hash of next state.
@@ -556,15 +986,17 @@ regex_edge_iterator (void *cls,
                      size_t len,
                      const struct GNUNET_HashCode *key)
 {
-  struct RegexSearchContext *ctx = cls;
+  struct EdgeMatchContext *emc = cls;
+  struct RegexSearchContext *ctx = emc->ctx;
   struct REGEX_INTERNAL_Search *info = ctx->info;
+  struct EdgeMatch match;
   const char *current;
   size_t current_len;
 
   GNUNET_STATISTICS_update (info->stats, "# regex edges iterated",
                             1, GNUNET_NO);
   current = &info->description[ctx->position];
-  current_len = strlen (info->description) - ctx->position;
+  current_len = info->description_len - ctx->position;
   if (len > current_len)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "Token too long, END\n");
@@ -575,25 +1007,42 @@ regex_edge_iterator (void *cls,
     LOG (GNUNET_ERROR_TYPE_DEBUG, "Token doesn't match, END\n");
     return GNUNET_YES;
   }
+  if (0 == len)
+    return GNUNET_YES;
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "Token matches, KEEP\n");
+  match.len = len;
+  match.key = *key;
+  GNUNET_array_append (emc->matches, emc->n_matches, match);
+  return GNUNET_YES;
+}
 
-  if (len > ctx->longest_match)
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG, "Token is longer, KEEP\n");
-    ctx->longest_match = len;
-    ctx->hash = *key;
-  }
-  else
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG, "Token is not longer, IGNORE\n");
-  }
 
-  LOG (GNUNET_ERROR_TYPE_DEBUG, "*    End of regex edge iterator\n");
-  return GNUNET_YES;
+/**
+ * Order edge matches by decreasing token length.
+ *
+ * @param a first `struct EdgeMatch`
+ * @param b second `struct EdgeMatch`
+ * @return comparison result for qsort()
+ */
+static int
+edge_match_cmp (const void *a,
+                const void *b)
+{
+  const struct EdgeMatch *ma = a;
+  const struct EdgeMatch *mb = b;
+
+  if (ma->len > mb->len)
+    return -1;
+  if (ma->len < mb->len)
+    return 1;
+  return 0;
 }
 
 
 /**
- * Jump to the next edge, with the longest matching token.
+ * Jump to the next edges matching the rest of the description.  All
+ * matching edges are followed in parallel, the longest tokens first,
+ * as they get us closest to the end of the description.
  *
  * @param block Block found in the DHT.
  * @param size Size of the block.
@@ -604,76 +1053,133 @@ regex_next_edge (const struct RegexBlock *block,
                  size_t size,
                  struct RegexSearchContext *ctx)
 {
-  struct RegexSearchContext *new_ctx;
   struct REGEX_INTERNAL_Search *info = ctx->info;
-  struct GNUNET_DHT_GetHandle *get_h;
-  struct GNUNET_HashCode *hash;
-  const char *rest;
+  struct EdgeMatchContext emc;
+  unsigned int i;
   int result;
 
   LOG (GNUNET_ERROR_TYPE_DEBUG, "Next edge\n");
-  /* Find the longest match for the current string position,
-   * among tokens in the given block */
-  ctx->longest_match = 0;
+  emc.ctx = ctx;
+  emc.matches = NULL;
+  emc.n_matches = 0;
   result = REGEX_BLOCK_iterate (block, size,
-                                &regex_edge_iterator, ctx);
+                                &regex_edge_iterator, &emc);
   GNUNET_break (GNUNET_OK == result);
 
   /* Did anything match? */
-  if (0 == ctx->longest_match)
+  if (0 == emc.n_matches)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
 	 "no match in block\n");
     return;
   }
+  qsort (emc.matches, emc.n_matches, sizeof (struct EdgeMatch),
+         &edge_match_cmp);
+  for (i = 0; i < emc.n_matches; i++)
+    branch_add (info, &emc.matches[i].key,
+                ctx->position + emc.matches[i].len);
+  GNUNET_free (emc.matches);
+}
 
-  hash = &ctx->hash;
-  new_ctx = GNUNET_new (struct RegexSearchContext);
-  new_ctx->info = info;
-  new_ctx->position = ctx->position + ctx->longest_match;
-  GNUNET_array_append (info->contexts, info->n_contexts, new_ctx);
 
-  /* Check whether we already have a DHT GET running for it */
-  if (GNUNET_YES ==
-      GNUNET_CONTAINER_multihashmap_contains (info->dht_get_handles, hash))
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-	 "GET for %s running, END\n",
-         GNUNET_h2s (hash));
-    GNUNET_CONTAINER_multihashmap_get_multiple (info->dht_get_results,
-                                                hash,
-                                                &regex_result_iterator,
-                                                new_ctx);
-    return; /* We are already looking for it */
-  }
+/**
+ * Closure for #block_cache_find_iterator().
+ */
+struct BlockCacheFindContext
+{
+  /**
+   * Block to look for.
+   */
+  const void *block;
 
-  GNUNET_STATISTICS_update (info->stats, "# regex nodes traversed",
-                            1, GNUNET_NO);
+  /**
+   * Number of bytes in @e block.
+   */
+  size_t size;
 
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Following edges at %s for offset %u in `%s'\n",
-       GNUNET_h2s (hash),
-       (unsigned int) ctx->position,
-       info->description);
-  rest = &new_ctx->info->description[new_ctx->position];
-  get_h =
-      GNUNET_DHT_get_start (info->dht,    /* handle */
-                            GNUNET_BLOCK_TYPE_REGEX, /* type */
-                            hash,     /* key to search */
-                            DHT_REPLICATION, /* replication level */
-                            DHT_OPT,
-                            rest, /* xquery */
-                            strlen (rest) + 1,     /* xquery bits */
-                            &dht_get_string_handler, new_ctx);
-  if (GNUNET_OK !=
-      GNUNET_CONTAINER_multihashmap_put(info->dht_get_handles,
-                                        hash,
-                                        get_h,
-                                        GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
+  /**
+   * Cache entry with the same block, NULL if none.
+   */
+  struct CachedBlock *found;
+};
+
+
+/**
+ * Check if a cached block is the one we look for.
+ *
+ * @param cls the `struct BlockCacheFindContext`
+ * @param key key of the state
+ * @param value a `struct CachedBlock`
+ * @return #GNUNET_NO if found, #GNUNET_YES to continue
+ */
+static int
+block_cache_find_iterator (void *cls,
+                           const struct GNUNET_HashCode *key,
+                           void *value)
+{
+  struct BlockCacheFindContext *fc = cls;
+  struct CachedBlock *cb = value;
+
+  if ( (cb->size != fc->size) ||
+       (0 != memcmp (&cb[1], fc->block, fc->size)) )
+    return GNUNET_YES;
+  fc->found = cb;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Remove a block from the cache and free it.
+ *
+ * @param cb the cache entry
+ */
+static void
+block_cache_remove (struct CachedBlock *cb)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (block_cache,
+                                                       &cb->key, cb));
+  GNUNET_CONTAINER_heap_remove_node (cb->hn);
+  GNUNET_free (cb);
+}
+
+
+static void
+block_cache_add (const struct GNUNET_HashCode *key,
+                 struct GNUNET_TIME_Absolute expiration,
+                 size_t size,
+                 const void *block)
+{
+  struct BlockCacheFindContext fc;
+  struct CachedBlock *cb;
+
+  fc.block = block;
+  fc.size = size;
+  fc.found = NULL;
+  GNUNET_CONTAINER_multihashmap_get_multiple (block_cache, key,
+                                              &block_cache_find_iterator,
+                                              &fc);
+  if (NULL != fc.found)
   {
-    GNUNET_break (0);
+    cb = fc.found;
+    cb->expiration = GNUNET_TIME_absolute_max (cb->expiration, expiration);
+    GNUNET_CONTAINER_heap_update_cost (block_cache_heap, cb->hn,
+                                       cb->expiration.abs_value_us);
     return;
   }
+  if (REGEX_BLOCK_CACHE_SIZE <=
+      GNUNET_CONTAINER_multihashmap_size (block_cache))
+    block_cache_remove (GNUNET_CONTAINER_heap_peek (block_cache_heap));
+  cb = GNUNET_malloc (sizeof (struct CachedBlock) + size);
+  cb->key = *key;
+  cb->expiration = expiration;
+  cb->size = size;
+  memcpy (&cb[1], block, size);
+  cb->hn = GNUNET_CONTAINER_heap_insert (block_cache_heap, cb,
+                                         expiration.abs_value_us);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (block_cache, key, cb,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
 }
 
 
@@ -698,11 +1204,8 @@ REGEX_INTERNAL_search (struct GNUNET_DHT_Handle *dht,
                        struct GNUNET_STATISTICS_Handle *stats)
 {
   struct REGEX_INTERNAL_Search *h;
-  struct GNUNET_DHT_GetHandle *get_h;
-  struct RegexSearchContext *ctx;
   struct GNUNET_HashCode key;
   size_t size;
-  size_t len;
 
   /* Initialize handle */
   GNUNET_assert (NULL != dht);
@@ -710,46 +1213,28 @@ REGEX_INTERNAL_search (struct GNUNET_DHT_Handle *dht,
   h = GNUNET_new (struct REGEX_INTERNAL_Search);
   h->dht = dht;
   h->description = GNUNET_strdup (string);
+  h->description_len = strlen (string);
   h->callback = callback;
   h->callback_cls = callback_cls;
   h->stats = stats;
-  h->dht_get_handles = GNUNET_CONTAINER_multihashmap_create (32, GNUNET_NO);
-  h->dht_get_results = GNUNET_CONTAINER_multihashmap_create (32, GNUNET_NO);
+  h->branches = GNUNET_CONTAINER_multihashmap_create (32, GNUNET_NO);
+  h->accept_handles = GNUNET_CONTAINER_multihashmap_create (4, GNUNET_NO);
+  if (0 == search_count++)
+  {
+    block_cache = GNUNET_CONTAINER_multihashmap_create (REGEX_BLOCK_CACHE_SIZE,
+                                                        GNUNET_NO);
+    block_cache_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  }
 
-  /* Initialize context */
-  len = strlen (string);
-  size = REGEX_INTERNAL_get_first_key (string, len, &key);
+  /* Start search in DHT */
+  size = REGEX_INTERNAL_get_first_key (string, h->description_len, &key);
   LOG (GNUNET_ERROR_TYPE_INFO,
        "Initial key for `%s' is %s (based on `%.*s')\n",
        string,
        GNUNET_h2s (&key),
        size,
        string);
-  ctx = GNUNET_new (struct RegexSearchContext);
-  ctx->position = size;
-  ctx->info = h;
-  GNUNET_array_append (h->contexts,
-                       h->n_contexts,
-                       ctx);
-  /* Start search in DHT */
-  get_h = GNUNET_DHT_get_start (h->dht,    /* handle */
-                                GNUNET_BLOCK_TYPE_REGEX, /* type */
-                                &key,     /* key to search */
-                                DHT_REPLICATION, /* replication level */
-                                DHT_OPT,
-                                &h->description[size],           /* xquery */
-                                // FIXME add BLOOMFILTER to exclude filtered peers
-                                len + 1 - size,                /* xquery bits */
-                                // FIXME add BLOOMFILTER SIZE
-                                &dht_get_string_handler, ctx);
-  GNUNET_break (
-    GNUNET_OK ==
-    GNUNET_CONTAINER_multihashmap_put (h->dht_get_handles,
-                                       &key,
-                                       get_h,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST)
-               );
-
+  branch_add (h, &key, size);
   return h;
 }
 
@@ -776,26 +1261,6 @@ regex_cancel_dht_get (void *cls,
 }
 
 
-/**
- * Iterator over hash map entries to free CadetRegexBlocks stored during the
- * search for connect_by_string.
- *
- * @param cls Closure (unused).
- * @param key Current key code (unused).
- * @param value CadetRegexBlock in the hash map.
- * @return #GNUNET_YES if we should continue to iterate,
- *         #GNUNET_NO if not.
- */
-static int
-regex_free_result (void *cls,
-                   const struct GNUNET_HashCode * key,
-                   void *value)
-{
-  GNUNET_free (value);
-  return GNUNET_YES;
-}
-
-
 /**
  * Cancel an ongoing regex search in the DHT and free all resources.
  *
@@ -804,22 +1269,35 @@ regex_free_result (void *cls,
 void
 REGEX_INTERNAL_search_cancel (struct REGEX_INTERNAL_Search *h)
 {
+  struct CachedBlock *cb;
   unsigned int i;
 
+  if (NULL != h->prune_task)
+    GNUNET_SCHEDULER_cancel (h->prune_task);
   GNUNET_free (h->description);
-  GNUNET_CONTAINER_multihashmap_iterate (h->dht_get_handles,
+  GNUNET_CONTAINER_multihashmap_iterate (h->accept_handles,
                                          &regex_cancel_dht_get, NULL);
-  GNUNET_CONTAINER_multihashmap_iterate (h->dht_get_results,
-                                         &regex_free_result, NULL);
-  GNUNET_CONTAINER_multihashmap_destroy (h->dht_get_results);
-  GNUNET_CONTAINER_multihashmap_destroy (h->dht_get_handles);
+  GNUNET_CONTAINER_multihashmap_destroy (h->accept_handles);
+  GNUNET_CONTAINER_multihashmap_destroy (h->branches);
   if (0 < h->n_contexts)
   {
     for (i = 0; i < h->n_contexts; i++)
+    {
+      if (NULL != h->contexts[i]->get)
+        GNUNET_DHT_get_stop (h->contexts[i]->get);
       GNUNET_free (h->contexts[i]);
+    }
     GNUNET_free (h->contexts);
   }
   GNUNET_free (h);
+  if (0 < --search_count)
+    return;
+  while (NULL != (cb = GNUNET_CONTAINER_heap_peek (block_cache_heap)))
+    block_cache_remove (cb);
+  GNUNET_CONTAINER_heap_destroy (block_cache_heap);
+  block_cache_heap = NULL;
+  GNUNET_CONTAINER_multihashmap_destroy (block_cache);
+  block_cache = NULL;
 }
 
 
@@ -92,6 +92,42 @@ REGEX_INTERNAL_eval (struct REGEX_INTERNAL_Automaton *a,
                      const char *string);
 
 
+/**
+ * How many strings REGEX_INTERNAL_eval_batch() walks through
+ * the transition table at the same time.
+ */
+#define REGEX_INTERNAL_EVAL_BATCH_WIDTH 8
+
+
+/**
+ * Evaluates 'count' strings against the given compiled regex.
+ *
+ * @param a automaton.
+ * @param strings strings to check.
+ * @param count number of 'strings'.
+ * @param results where to store the results:
+ *        0 if a string matches, non 0 otherwise.
+ */
+void
+REGEX_INTERNAL_eval_batch (struct REGEX_INTERNAL_Automaton *a,
+                           const char *const *strings,
+                           unsigned int count,
+                           int *results);
+
+
+/**
+ * Compile the given DFA into a dense transition table with compressed byte
+ * classes, which speeds up REGEX_INTERNAL_eval() and
+ * REGEX_INTERNAL_eval_batch().
+ *
+ * @param a DFA, constructed without path compression ('max_path_len' 1).
+ *
+ * @return #GNUNET_OK on success, #GNUNET_NO if 'a' can not be compiled.
+ */
+int
+REGEX_INTERNAL_dfa_compile_table (struct REGEX_INTERNAL_Automaton *a);
+
+
 /**
  * Get the first key for the given @a input_string. This hashes
  * the first x bits of the @a input_string.
@@ -242,6 +242,50 @@ test_automaton (struct REGEX_INTERNAL_Automaton *a, regex_t * rx,
   return result;
 }
 
+/**
+ * Compile the automaton @a a into a transition table and check that
+ * single and batch evaluation with it give the expected results.
+ *
+ * @param a DFA without path compression
+ * @param rx compiled regex to compare against
+ * @param rxstr regular expression and strings with expected results to
+ *              match against.
+ *
+ * @return 0 on successfull, non 0 otherwise
+ */
+static int
+test_table (struct REGEX_INTERNAL_Automaton *a, regex_t * rx,
+            struct Regex_String_Pair *rxstr)
+{
+  int results[rxstr->string_count];
+  int result;
+  int i;
+
+  if (GNUNET_OK != REGEX_INTERNAL_dfa_compile_table (a))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Could not compile DFA for regex %s\n", rxstr->regex);
+    return 1;
+  }
+  result = test_automaton (a, rx, rxstr);
+  REGEX_INTERNAL_eval_batch (a, (const char *const *) rxstr->strings,
+                             rxstr->string_count, results);
+  for (i = 0; i < rxstr->string_count; i++)
+  {
+    if ((match == rxstr->expected_results[i]) != (0 == results[i]))
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                  "Unexpected batch result:\nregex: %s\nstring: %s\n"
+                  "expected result: %i\nbatch result: %i\n",
+                  rxstr->regex, rxstr->strings[i],
+                  rxstr->expected_results[i], results[i]);
+      result = 1;
+    }
+  }
+  return result;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -253,6 +297,7 @@ main (int argc, char *argv[])
   int check_nfa;
   int check_dfa;
   int check_rand;
+  int check_table;
   char *check_proof;
 
   struct Regex_String_Pair rxstr[19] = {
@@ -326,6 +371,7 @@ main (int argc, char *argv[])
   check_nfa = 0;
   check_dfa = 0;
   check_rand = 0;
+  check_table = 0;
 
   for (i = 0; i < 19; i++)
   {
@@ -354,6 +400,11 @@ main (int argc, char *argv[])
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "check_proof: %s\n", check_proof);
     GNUNET_free_non_null (check_proof);
 
+    /* Compiled DFA test */
+    a = REGEX_INTERNAL_construct_dfa (rxstr[i].regex, strlen (rxstr[i].regex), 1);
+    check_table += test_table (a, &rx, &rxstr[i]);
+    REGEX_INTERNAL_automaton_destroy (a);
+
     regfree (&rx);
   }
 
@@ -362,5 +413,5 @@ main (int argc, char *argv[])
   for (i = 0; i < 20; i++)
     check_rand += test_random (50, 60, 10);
 
-  return check_nfa + check_dfa + check_rand;
+  return check_nfa + check_dfa + check_rand + check_table;
 }
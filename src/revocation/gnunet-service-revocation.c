@@ -49,6 +49,63 @@
 #include <gcrypt.h>
 
 
+/**
+ * Magic number identifying the revocation index file ("RVKI").
+ */
+#define INDEX_MAGIC 0x52564b49
+
+/**
+ * Initial (and minimum) number of slots in the revocation index.
+ * Must be a power of two.
+ */
+#define INDEX_MIN_SLOTS 1024
+
+/**
+ * How many revocations do we verify in one crypto offload job?
+ */
+#define VERIFY_BATCH_SIZE 32
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of the revocation index file.  The index remembers the
+ * hashes of all revocation messages in the database whose proof of
+ * work and signature we already verified, so that we do not have to
+ * verify them again whenever the service starts.  The header is
+ * followed by @e slot_count `struct GNUNET_HashCode`s forming an
+ * open-addressing hash table (all-zero slots are empty).
+ */
+struct IndexHeader
+{
+
+  /**
+   * Must be #INDEX_MAGIC, in NBO.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Generation of the verification flags, in NBO.  This is the
+   * amount of work that was required when the entries were verified;
+   * if the requirement changes, all entries are verified again.
+   */
+  uint32_t generation GNUNET_PACKED;
+
+  /**
+   * Number of slots in the table, a power of two, in NBO.
+   */
+  uint32_t slot_count GNUNET_PACKED;
+
+  /**
+   * Number of used slots in the table, in NBO.
+   */
+  uint32_t entry_count GNUNET_PACKED;
+
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * Per-peer information.
  */
@@ -78,6 +135,112 @@ struct PeerEntry
 };
 
 
+/**
+ * A revocation whose proof of work and signature are to be checked
+ * by the crypto offload pool.
+ */
+struct PendingRevocation
+{
+
+  /**
+   * Kept in a DLL while waiting to be put into a batch.
+   */
+  struct PendingRevocation *next;
+
+  /**
+   * Kept in a DLL while waiting to be put into a batch.
+   */
+  struct PendingRevocation *prev;
+
+  /**
+   * Client that submitted the revocation, NULL if it came from
+   * a peer or the database (or if the client disconnected meanwhile).
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * The revocation being verified.
+   */
+  struct RevokeMessage rm;
+
+  /**
+   * Result of the verification, set by the offload job.
+   */
+  int valid;
+
+  /**
+   * #GNUNET_YES if the revocation was loaded from our database
+   * (and thus must not be written to it again).
+   */
+  int from_db;
+
+};
+
+
+/**
+ * A batch of revocations verified by a single offload job.
+ */
+struct VerificationBatch
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct VerificationBatch *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct VerificationBatch *prev;
+
+  /**
+   * The verification job.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * The revocations in this batch.
+   */
+  struct PendingRevocation *prs[VERIFY_BATCH_SIZE];
+
+  /**
+   * Number of valid entries in @e prs.
+   */
+  unsigned int count;
+
+};
+
+
+/**
+ * Head of the revocations waiting to be verified.
+ */
+static struct PendingRevocation *pr_head;
+
+/**
+ * Tail of the revocations waiting to be verified.
+ */
+static struct PendingRevocation *pr_tail;
+
+/**
+ * Number of entries in the #pr_head DLL.
+ */
+static unsigned int pr_count;
+
+/**
+ * Head of the batches being verified.
+ */
+static struct VerificationBatch *vb_head;
+
+/**
+ * Tail of the batches being verified.
+ */
+static struct VerificationBatch *vb_tail;
+
+/**
+ * Task that starts verifying the waiting revocations.
+ */
+static struct GNUNET_SCHEDULER_Task *batch_task;
+
 /**
  * Set from all revocations known to us.
  */
@@ -129,6 +292,26 @@ static struct GNUNET_SERVER_NotificationContext *nc;
  */
 static struct GNUNET_DISK_FileHandle *revocation_db;
 
+/**
+ * File handle for the revocation index, NULL if we have none.
+ */
+static struct GNUNET_DISK_FileHandle *index_fh;
+
+/**
+ * Memory mapping of #index_fh.
+ */
+static struct GNUNET_DISK_MapHandle *index_mh;
+
+/**
+ * Header of the mapped revocation index, NULL if not mapped.
+ */
+static struct IndexHeader *index_hdr;
+
+/**
+ * Slots of the mapped revocation index (follow #index_hdr).
+ */
+static struct GNUNET_HashCode *index_slots;
+
 /**
  * Handle for us listening to incoming revocation set union requests.
  */
@@ -201,35 +384,297 @@ delete_peer_entry(const struct GNUNET_PeerIdentity *peer)
 }
 
 
+/**
+ * Find the slot for @a hc in an index table.
+ *
+ * @param slots the table
+ * @param slot_count number of slots in @a slots, a power of two
+ * @param hc hash to look for
+ * @return the slot holding @a hc, or the empty slot where it belongs
+ */
+static struct GNUNET_HashCode *
+index_find_slot (struct GNUNET_HashCode *slots,
+                 uint32_t slot_count,
+                 const struct GNUNET_HashCode *hc)
+{
+  static const struct GNUNET_HashCode zero;
+  uint32_t off;
+
+  off = hc->bits[0] & (slot_count - 1);
+  while ( (0 != memcmp (&slots[off],
+                        hc,
+                        sizeof (struct GNUNET_HashCode))) &&
+          (0 != memcmp (&slots[off],
+                        &zero,
+                        sizeof (struct GNUNET_HashCode))) )
+    off = (off + 1) & (slot_count - 1);
+  return &slots[off];
+}
+
+
+/**
+ * Release the mapping of the revocation index.
+ */
+static void
+index_unmap ()
+{
+  if (NULL == index_mh)
+    return;
+  GNUNET_DISK_file_unmap (index_mh);
+  index_mh = NULL;
+  index_hdr = NULL;
+  index_slots = NULL;
+}
+
+
+/**
+ * Map the revocation index with the given number of slots.
+ *
+ * @param slot_count number of slots in the index file
+ * @return #GNUNET_OK on success
+ */
+static int
+index_map (uint32_t slot_count)
+{
+  void *mem;
+
+  mem = GNUNET_DISK_file_map (index_fh,
+                              &index_mh,
+                              GNUNET_DISK_MAP_TYPE_READWRITE,
+                              sizeof (struct IndexHeader) +
+                              slot_count * sizeof (struct GNUNET_HashCode));
+  if (NULL == mem)
+  {
+    index_mh = NULL;
+    return GNUNET_SYSERR;
+  }
+  index_hdr = mem;
+  index_slots = (struct GNUNET_HashCode *) &index_hdr[1];
+  return GNUNET_OK;
+}
+
+
+/**
+ * (Re)write the revocation index with @a slot_count slots, keeping
+ * all entries of the currently mapped index (if any), and map it.
+ *
+ * @param slot_count new number of slots, a power of two
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if we have no index now
+ */
+static int
+index_resize (uint32_t slot_count)
+{
+  static const struct GNUNET_HashCode zero;
+  struct IndexHeader *hdr;
+  struct GNUNET_HashCode *slots;
+  uint32_t old_count;
+  uint32_t entries;
+  uint32_t i;
+  size_t size;
+
+  size = sizeof (struct IndexHeader) +
+    slot_count * sizeof (struct GNUNET_HashCode);
+  hdr = GNUNET_malloc_large (size);
+  if (NULL == hdr)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "malloc");
+    index_unmap ();
+    return GNUNET_SYSERR;
+  }
+  memset (hdr, 0, size);
+  slots = (struct GNUNET_HashCode *) &hdr[1];
+  entries = 0;
+  old_count = (NULL == index_hdr) ? 0 : ntohl (index_hdr->slot_count);
+  for (i = 0; i < old_count; i++)
+  {
+    if (0 == memcmp (&index_slots[i],
+                     &zero,
+                     sizeof (struct GNUNET_HashCode)))
+      continue;
+    *index_find_slot (slots,
+                      slot_count,
+                      &index_slots[i]) = index_slots[i];
+    entries++;
+  }
+  hdr->magic = htonl (INDEX_MAGIC);
+  hdr->generation = htonl ((uint32_t) revocation_work_required);
+  hdr->slot_count = htonl (slot_count);
+  hdr->entry_count = htonl (entries);
+  index_unmap ();
+  if ( (0 !=
+        GNUNET_DISK_file_seek (index_fh,
+                               0,
+                               GNUNET_DISK_SEEK_SET)) ||
+       (size !=
+        GNUNET_DISK_file_write (index_fh,
+                                hdr,
+                                size)) ||
+       (GNUNET_OK !=
+        GNUNET_DISK_file_sync (index_fh)) ||
+       (GNUNET_OK !=
+        index_map (slot_count)) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "write");
+    GNUNET_free (hdr);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (hdr);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Open (or create) the revocation index belonging to the database
+ * @a db_fn.  An index from an older generation or a damaged index is
+ * replaced by an empty one.  Failing to open the index is not fatal;
+ * all revocations are then verified at every start.
+ *
+ * @param db_fn name of the revocation database
+ */
+static void
+index_open (const char *db_fn)
+{
+  struct IndexHeader hdr;
+  char *fn;
+  off_t size;
+  uint32_t slot_count;
+
+  GNUNET_asprintf (&fn,
+                   "%s.idx",
+                   db_fn);
+  index_fh = GNUNET_DISK_file_open (fn,
+                                    GNUNET_DISK_OPEN_READWRITE |
+                                    GNUNET_DISK_OPEN_CREATE,
+                                    GNUNET_DISK_PERM_USER_READ |
+                                    GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == index_fh)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_WARNING,
+                              "open",
+                              fn);
+    GNUNET_free (fn);
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_DISK_file_handle_size (index_fh,
+                                    &size))
+    size = 0;
+  if ( (size >= (off_t) sizeof (hdr)) &&
+       (sizeof (hdr) ==
+        GNUNET_DISK_file_read (index_fh,
+                               &hdr,
+                               sizeof (hdr))) &&
+       (INDEX_MAGIC == ntohl (hdr.magic)) &&
+       (revocation_work_required == ntohl (hdr.generation)) )
+  {
+    slot_count = ntohl (hdr.slot_count);
+    if ( (slot_count >= INDEX_MIN_SLOTS) &&
+         (0 == (slot_count & (slot_count - 1))) &&
+         ((uint64_t) size >= sizeof (hdr) +
+          (uint64_t) slot_count * sizeof (struct GNUNET_HashCode)) &&
+         (GNUNET_OK == index_map (slot_count)) )
+    {
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Revocation index `%s' lists %u verified revocations\n",
+                  fn,
+                  ntohl (hdr.entry_count));
+      GNUNET_free (fn);
+      return;
+    }
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Creating new revocation index `%s'\n",
+              fn);
+  GNUNET_free (fn);
+  if (GNUNET_OK != index_resize (INDEX_MIN_SLOTS))
+  {
+    GNUNET_DISK_file_close (index_fh);
+    index_fh = NULL;
+  }
+}
+
+
+/**
+ * Check if the revocation index lists @a mh as verified.
+ *
+ * @param mh hash of a revocation message
+ * @return #GNUNET_YES if the message was verified before
+ */
+static int
+index_contains (const struct GNUNET_HashCode *mh)
+{
+  if (NULL == index_hdr)
+    return GNUNET_NO;
+  return (0 == memcmp (mh,
+                       index_find_slot (index_slots,
+                                        ntohl (index_hdr->slot_count),
+                                        mh),
+                       sizeof (struct GNUNET_HashCode)))
+    ? GNUNET_YES
+    : GNUNET_NO;
+}
+
+
+/**
+ * Record in the revocation index that the revocation message with
+ * hash @a mh was verified.  The caller must sync the mapping.
+ *
+ * @param mh hash of a revocation message
+ */
+static void
+index_add (const struct GNUNET_HashCode *mh)
+{
+  struct GNUNET_HashCode *slot;
+  uint32_t slot_count;
+  uint32_t entries;
+
+  if (NULL == index_hdr)
+    return;
+  slot_count = ntohl (index_hdr->slot_count);
+  entries = ntohl (index_hdr->entry_count);
+  /* keep the load factor at or below 1/2 */
+  if ( (2 * (entries + 1) > slot_count) &&
+       (GNUNET_OK != index_resize (2 * slot_count)) )
+    return;
+  slot_count = ntohl (index_hdr->slot_count);
+  slot = index_find_slot (index_slots,
+                          slot_count,
+                          mh);
+  if (0 == memcmp (slot,
+                   mh,
+                   sizeof (struct GNUNET_HashCode)))
+    return;
+  *slot = *mh;
+  index_hdr->entry_count = htonl (entries + 1);
+}
+
+
 /**
  * An revoke message has been received, check that it is well-formed.
+ * Runs in the crypto offload pool, so must not log.
  *
- * @param rm the message to verify
+ * @param cls the `struct RevokeMessage` to verify
  * @return #GNUNET_YES if the message is verified
  *         #GNUNET_NO if the key/signature don't verify
  */
 static int
-verify_revoke_message (const struct RevokeMessage *rm)
+verify_revoke_message (void *cls)
 {
+  const struct RevokeMessage *rm = cls;
+
   if (GNUNET_YES !=
       GNUNET_REVOCATION_check_pow (&rm->public_key,
 				   rm->proof_of_work,
 				   (unsigned int) revocation_work_required))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Proof of work invalid!\n");
-    GNUNET_break_op (0);
     return GNUNET_NO;
-  }
   if (GNUNET_OK !=
-      GNUNET_CRYPTO_ecdsa_verify (GNUNET_SIGNATURE_PURPOSE_REVOCATION,
-				&rm->purpose,
-				&rm->signature,
-				&rm->public_key))
-  {
-    GNUNET_break_op (0);
+      GNUNET_CRYPTO_ecdsa_verify_nolog (GNUNET_SIGNATURE_PURPOSE_REVOCATION,
+                                        &rm->purpose,
+                                        &rm->signature,
+                                        &rm->public_key))
     return GNUNET_NO;
-  }
   return GNUNET_YES;
 }
 
@@ -306,63 +751,85 @@ do_flood (void *cls,
 
 
 /**
- * Publicize revocation message.   Stores the message locally in the
- * database and passes it to all connected neighbours (and adds it to
- * the set for future connections).
+ * Check if we already know about the revocation @a rm.
  *
- * @param rm message to publicize
- * @return #GNUNET_OK on success, #GNUNET_NO if we encountered an error,
- *         #GNUNET_SYSERR if the message was malformed
+ * @param rm revocation to check
+ * @param hc set to the hash of the revoked key
+ * @return #GNUNET_YES if @a rm is a duplicate
  */
 static int
-publicize_rm (const struct RevokeMessage *rm)
+is_duplicate (const struct RevokeMessage *rm,
+              struct GNUNET_HashCode *hc)
 {
-  struct RevokeMessage *cp;
-  struct GNUNET_HashCode hc;
-  struct GNUNET_SET_Element e;
-
   GNUNET_CRYPTO_hash (&rm->public_key,
                       sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
-                      &hc);
-  if (GNUNET_YES ==
+                      hc);
+  if (GNUNET_YES !=
       GNUNET_CONTAINER_multihashmap_contains (revocation_map,
-                                              &hc))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Duplicate revocation received from peer. Ignored.\n");
-    return GNUNET_OK;
-  }
-  if (GNUNET_OK !=
-      verify_revoke_message (rm))
-  {
-    GNUNET_break_op (0);
-    return GNUNET_SYSERR;
-  }
-  /* write to disk */
-  if (sizeof (struct RevokeMessage) !=
-      GNUNET_DISK_file_write (revocation_db,
-                              rm,
-                              sizeof (struct RevokeMessage)))
-  {
-    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
-                         "write");
+                                              hc))
     return GNUNET_NO;
-  }
-  if (GNUNET_OK !=
-      GNUNET_DISK_file_sync (revocation_db))
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Duplicate revocation received from peer. Ignored.\n");
+  return GNUNET_YES;
+}
+
+
+/**
+ * Tell a client about the outcome of its revocation request.
+ *
+ * @param client client to notify
+ * @param ret #GNUNET_OK if the revocation is now known,
+ *            #GNUNET_NO if we encountered an error,
+ *            #GNUNET_SYSERR if the message was malformed
+ */
+static void
+send_revoke_response (struct GNUNET_SERVER_Client *client,
+                      int ret)
+{
+  struct RevocationResponseMessage rrm;
+
+  if (GNUNET_SYSERR == ret)
   {
-    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
-                         "sync");
-    return GNUNET_NO;
+    GNUNET_break_op (0);
+    GNUNET_SERVER_receive_done (client,
+                                GNUNET_SYSERR);
+    return;
   }
-  /* keep copy in memory */
+  rrm.header.size = htons (sizeof (struct RevocationResponseMessage));
+  rrm.header.type = htons (GNUNET_MESSAGE_TYPE_REVOCATION_REVOKE_RESPONSE);
+  rrm.is_valid = htonl ((GNUNET_OK == ret) ? GNUNET_NO : GNUNET_YES);
+  GNUNET_SERVER_notification_context_add (nc,
+                                          client);
+  GNUNET_SERVER_notification_context_unicast (nc,
+                                              client,
+                                              &rrm.header,
+                                              GNUNET_NO);
+  GNUNET_SERVER_receive_done (client,
+                              GNUNET_OK);
+}
+
+
+/**
+ * Keep a verified revocation message in memory and add it to the set
+ * for future connections.
+ *
+ * @param rm message to remember
+ * @param hc hash of the revoked key
+ * @return the in-memory copy of @a rm
+ */
+static struct RevokeMessage *
+remember_rm (const struct RevokeMessage *rm,
+             const struct GNUNET_HashCode *hc)
+{
+  struct RevokeMessage *cp;
+  struct GNUNET_SET_Element e;
+
   cp = (struct RevokeMessage *) GNUNET_copy_message (&rm->header);
   GNUNET_break (GNUNET_OK ==
                 GNUNET_CONTAINER_multihashmap_put (revocation_map,
-                                                   &hc,
+                                                   hc,
                                                    cp,
                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-  /* add to set for future connections */
   e.size = htons (rm->header.size);
   e.element_type = 0;
   e.data = rm;
@@ -373,21 +840,296 @@ publicize_rm (const struct RevokeMessage *rm)
                               NULL))
   {
     GNUNET_break (0);
-    return GNUNET_OK;
   }
   else
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Added revocation info to SET\n");
   }
-  /* flood to neighbours */
-  GNUNET_CONTAINER_multipeermap_iterate (peers,
-					 &do_flood,
-                                         cp);
+  return cp;
+}
+
+
+/**
+ * Free a pending revocation that is waiting to be verified.
+ *
+ * @param pr revocation to free
+ */
+static void
+free_pending (struct PendingRevocation *pr)
+{
+  GNUNET_CONTAINER_DLL_remove (pr_head,
+                               pr_tail,
+                               pr);
+  pr_count--;
+  GNUNET_free (pr);
+}
+
+
+/**
+ * Free a verification batch and all revocations in it.
+ *
+ * @param vb batch to free
+ */
+static void
+free_batch (struct VerificationBatch *vb)
+{
+  unsigned int i;
+
+  GNUNET_CONTAINER_DLL_remove (vb_head,
+                               vb_tail,
+                               vb);
+  if (NULL != vb->job)
+    GNUNET_CRYPTO_offload_cancel (vb->job);
+  for (i = 0; i < vb->count; i++)
+    GNUNET_free (vb->prs[i]);
+  GNUNET_free (vb);
+}
+
+
+/**
+ * Verify a batch of revocations.  Runs in the crypto offload pool,
+ * so must not log.
+ *
+ * @param cls the `struct VerificationBatch`
+ * @return #GNUNET_OK
+ */
+static int
+verify_batch (void *cls)
+{
+  struct VerificationBatch *vb = cls;
+  unsigned int i;
+
+  for (i = 0; i < vb->count; i++)
+    vb->prs[i]->valid = verify_revoke_message (&vb->prs[i]->rm);
   return GNUNET_OK;
 }
 
 
+/**
+ * The crypto offload pool is done verifying a batch of revocations.
+ * Store the new valid ones in the database (with a single sync for
+ * the whole batch), record them in the index, keep them in memory
+ * and flood them.
+ *
+ * @param cls the `struct VerificationBatch`
+ * @param result #GNUNET_OK
+ */
+static void
+verification_done (void *cls,
+                   int result)
+{
+  struct VerificationBatch *vb = cls;
+  struct PendingRevocation *pr;
+  struct RevokeMessage *cp;
+  struct GNUNET_HashCode hc[VERIFY_BATCH_SIZE];
+  struct GNUNET_HashCode mh;
+  int ret[VERIFY_BATCH_SIZE];
+  int store[VERIFY_BATCH_SIZE];
+  unsigned int written;
+  unsigned int i;
+  unsigned int j;
+
+  vb->job = NULL;
+  written = 0;
+  for (i = 0; i < vb->count; i++)
+  {
+    pr = vb->prs[i];
+    store[i] = GNUNET_NO;
+    if (GNUNET_YES != pr->valid)
+    {
+      if (GNUNET_YES == pr->from_db)
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                    _("Ignoring invalid revocation in database\n"));
+      }
+      else
+      {
+        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                    "Proof of work or signature invalid!\n");
+        GNUNET_break_op (0);
+      }
+      ret[i] = GNUNET_SYSERR;
+      continue;
+    }
+    ret[i] = GNUNET_OK;
+    if (GNUNET_YES == is_duplicate (&pr->rm,
+                                    &hc[i]))
+      continue;             /* verified concurrently */
+    for (j = 0; j < i; j++)
+      if ( (GNUNET_YES == store[j]) &&
+           (0 == memcmp (&hc[j],
+                         &hc[i],
+                         sizeof (struct GNUNET_HashCode))) )
+        break;
+    if (j < i)
+      continue;             /* duplicate within this batch */
+    if (GNUNET_NO == pr->from_db)
+    {
+      if (sizeof (struct RevokeMessage) !=
+          GNUNET_DISK_file_write (revocation_db,
+                                  &pr->rm,
+                                  sizeof (struct RevokeMessage)))
+      {
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                             "write");
+        ret[i] = GNUNET_NO;
+        continue;
+      }
+      written++;
+    }
+    store[i] = GNUNET_YES;
+  }
+  if ( (0 < written) &&
+       (GNUNET_OK !=
+        GNUNET_DISK_file_sync (revocation_db)) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_ERROR,
+                         "sync");
+    for (i = 0; i < vb->count; i++)
+      if ( (GNUNET_YES == store[i]) &&
+           (GNUNET_NO == vb->prs[i]->from_db) )
+      {
+        store[i] = GNUNET_NO;
+        ret[i] = GNUNET_NO;
+      }
+  }
+  for (i = 0; i < vb->count; i++)
+  {
+    pr = vb->prs[i];
+    if (GNUNET_YES != store[i])
+      continue;
+    GNUNET_CRYPTO_hash (&pr->rm,
+                        sizeof (struct RevokeMessage),
+                        &mh);
+    index_add (&mh);
+    cp = remember_rm (&pr->rm,
+                      &hc[i]);
+    /* flood to neighbours */
+    GNUNET_CONTAINER_multipeermap_iterate (peers,
+                                           &do_flood,
+                                           cp);
+  }
+  if ( (NULL != index_mh) &&
+       (GNUNET_OK !=
+        GNUNET_DISK_file_map_sync (index_mh)) )
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "msync");
+  for (i = 0; i < vb->count; i++)
+    if (NULL != vb->prs[i]->client)
+      send_revoke_response (vb->prs[i]->client,
+                            ret[i]);
+  free_batch (vb);
+}
+
+
+/**
+ * Hand up to #VERIFY_BATCH_SIZE waiting revocations to the crypto
+ * offload pool.
+ */
+static void
+start_batch ()
+{
+  struct VerificationBatch *vb;
+  struct PendingRevocation *pr;
+
+  vb = GNUNET_new (struct VerificationBatch);
+  while ( (NULL != (pr = pr_head)) &&
+          (vb->count < VERIFY_BATCH_SIZE) )
+  {
+    GNUNET_CONTAINER_DLL_remove (pr_head,
+                                 pr_tail,
+                                 pr);
+    pr_count--;
+    vb->prs[vb->count++] = pr;
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (vb_head,
+                                    vb_tail,
+                                    vb);
+  vb->job = GNUNET_CRYPTO_offload (&verify_batch,
+                                   vb,
+                                   &verification_done,
+                                   vb);
+}
+
+
+/**
+ * Start verifying all waiting revocations.  Runs once the current
+ * scheduler round is done, so that revocations arriving together
+ * (e.g. from a set union) are verified together.
+ *
+ * @param cls NULL
+ * @param tc scheduler context (unused)
+ */
+static void
+batch_task_cb (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  batch_task = NULL;
+  while (NULL != pr_head)
+    start_batch ();
+}
+
+
+/**
+ * Queue a revocation for verification.
+ *
+ * @param rm revocation to verify
+ * @param client client to send the result to, NULL for none
+ * @param from_db #GNUNET_YES if @a rm was loaded from our database
+ */
+static void
+queue_rm (const struct RevokeMessage *rm,
+          struct GNUNET_SERVER_Client *client,
+          int from_db)
+{
+  struct PendingRevocation *pr;
+
+  pr = GNUNET_new (struct PendingRevocation);
+  pr->rm = *rm;
+  pr->client = client;
+  pr->from_db = from_db;
+  GNUNET_CONTAINER_DLL_insert_tail (pr_head,
+                                    pr_tail,
+                                    pr);
+  pr_count++;
+  if (VERIFY_BATCH_SIZE <= pr_count)
+    start_batch ();
+  else if (NULL == batch_task)
+    batch_task = GNUNET_SCHEDULER_add_now (&batch_task_cb,
+                                           NULL);
+}
+
+
+/**
+ * Publicize revocation message.  Once its proof of work and signature
+ * are verified, stores the message locally in the database and passes
+ * it to all connected neighbours (and adds it to the set for future
+ * connections).
+ *
+ * @param rm message to publicize
+ * @param client client to send the result to, NULL for none
+ */
+static void
+publicize_rm (const struct RevokeMessage *rm,
+              struct GNUNET_SERVER_Client *client)
+{
+  struct GNUNET_HashCode hc;
+
+  if (GNUNET_YES == is_duplicate (rm,
+                                  &hc))
+  {
+    if (NULL != client)
+      send_revoke_response (client,
+                            GNUNET_OK);
+    return;
+  }
+  queue_rm (rm,
+            client,
+            GNUNET_NO);
+}
+
+
 /**
  * Handle REVOKE message from client.
  *
@@ -401,30 +1143,37 @@ handle_revoke_message (void *cls,
                        const struct GNUNET_MessageHeader *message)
 {
   const struct RevokeMessage *rm;
-  struct RevocationResponseMessage rrm;
-  int ret;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received REVOKE message from client\n");
   rm = (const struct RevokeMessage *) message;
-  if (GNUNET_SYSERR == (ret = publicize_rm (rm)))
-  {
-    GNUNET_break_op (0);
-    GNUNET_SERVER_receive_done (client,
-                                GNUNET_SYSERR);
-    return;
-  }
-  rrm.header.size = htons (sizeof (struct RevocationResponseMessage));
-  rrm.header.type = htons (GNUNET_MESSAGE_TYPE_REVOCATION_REVOKE_RESPONSE);
-  rrm.is_valid = htonl ((GNUNET_OK == ret) ? GNUNET_NO : GNUNET_YES);
-  GNUNET_SERVER_notification_context_add (nc,
-                                          client);
-  GNUNET_SERVER_notification_context_unicast (nc,
-                                              client,
-                                              &rrm.header,
-                                              GNUNET_NO);
-  GNUNET_SERVER_receive_done (client,
-                              GNUNET_OK);
+  publicize_rm (rm,
+                client);
+}
+
+
+/**
+ * A client disconnected.  Forget about it in all pending
+ * revocations (which we still process).
+ *
+ * @param cls unused
+ * @param client the client that disconnected, may be NULL
+ */
+static void
+handle_client_disconnect (void *cls,
+                          struct GNUNET_SERVER_Client *client)
+{
+  struct PendingRevocation *pr;
+  struct VerificationBatch *vb;
+  unsigned int i;
+
+  for (pr = pr_head; NULL != pr; pr = pr->next)
+    if (pr->client == client)
+      pr->client = NULL;
+  for (vb = vb_head; NULL != vb; vb = vb->next)
+    for (i = 0; i < vb->count; i++)
+      if (vb->prs[i]->client == client)
+        vb->prs[i]->client = NULL;
 }
 
 
@@ -445,7 +1194,8 @@ handle_p2p_revoke_message (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
 	      "Received REVOKE message from peer\n");
   rm = (const struct RevokeMessage *) message;
-  GNUNET_break_op (GNUNET_SYSERR != publicize_rm (rm));
+  publicize_rm (rm,
+                NULL);
   return GNUNET_OK;
 }
 
@@ -668,6 +1418,15 @@ static void
 shutdown_task (void *cls,
 	       const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  if (NULL != batch_task)
+  {
+    GNUNET_SCHEDULER_cancel (batch_task);
+    batch_task = NULL;
+  }
+  while (NULL != vb_head)
+    free_batch (vb_head);
+  while (NULL != pr_head)
+    free_pending (pr_head);
   if (NULL != revocation_set)
   {
     GNUNET_SET_destroy (revocation_set);
@@ -703,6 +1462,12 @@ shutdown_task (void *cls,
     GNUNET_DISK_file_close (revocation_db);
     revocation_db = NULL;
   }
+  index_unmap ();
+  if (NULL != index_fh)
+  {
+    GNUNET_DISK_file_close (index_fh);
+    index_fh = NULL;
+  }
   GNUNET_CONTAINER_multihashmap_iterate (revocation_map,
                                          &free_entry,
                                          NULL);
@@ -810,8 +1575,13 @@ run (void *cls,
   };
   char *fn;
   uint64_t left;
-  struct RevokeMessage *rm;
+  uint64_t count;
+  uint64_t i;
+  unsigned int trusted;
+  struct GNUNET_DISK_MapHandle *mh;
+  const struct RevokeMessage *rms;
   struct GNUNET_HashCode hc;
+  struct GNUNET_HashCode mh_hash;
 
   if (GNUNET_OK !=
       GNUNET_CONFIGURATION_get_value_filename (c,
@@ -877,40 +1647,84 @@ run (void *cls,
   if (GNUNET_OK !=
       GNUNET_DISK_file_size (fn, &left, GNUNET_YES, GNUNET_YES))
     left = 0;
-  while (left > sizeof (struct RevokeMessage))
+  count = left / sizeof (struct RevokeMessage);
+  /* size the map once instead of rehashing while loading */
+  GNUNET_CONTAINER_multihashmap_reserve (revocation_map,
+                                         count);
+  peers = GNUNET_CONTAINER_multipeermap_create (128,
+                                                GNUNET_YES);
+  index_open (fn);
+  trusted = 0;
+  if (0 < count)
   {
-    rm = GNUNET_new (struct RevokeMessage);
-    if (sizeof (struct RevokeMessage) !=
-        GNUNET_DISK_file_read (revocation_db,
-                               rm,
-                               sizeof (struct RevokeMessage)))
+    rms = GNUNET_DISK_file_map (revocation_db,
+                                &mh,
+                                GNUNET_DISK_MAP_TYPE_READ,
+                                count * sizeof (struct RevokeMessage));
+    if (NULL == rms)
     {
       GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
-                                "read",
+                                "mmap",
                                 fn);
-      GNUNET_free (rm);
       GNUNET_SCHEDULER_shutdown ();
       GNUNET_free (fn);
       return;
     }
-    GNUNET_break (0 == ntohl (rm->reserved));
-    GNUNET_CRYPTO_hash (&rm->public_key,
-                        sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
-                        &hc);
-    GNUNET_break (GNUNET_OK ==
-                  GNUNET_CONTAINER_multihashmap_put (revocation_map,
-                                                     &hc,
-                                                     rm,
-                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    for (i = 0; i < count; i++)
+    {
+      GNUNET_break (0 == ntohl (rms[i].reserved));
+      GNUNET_CRYPTO_hash (&rms[i].public_key,
+                          sizeof (struct GNUNET_CRYPTO_EcdsaPublicKey),
+                          &hc);
+      if (GNUNET_YES ==
+          GNUNET_CONTAINER_multihashmap_contains (revocation_map,
+                                                  &hc))
+        continue;
+      GNUNET_CRYPTO_hash (&rms[i],
+                          sizeof (struct RevokeMessage),
+                          &mh_hash);
+      if (GNUNET_YES == index_contains (&mh_hash))
+      {
+        /* verified in an earlier run */
+        (void) remember_rm (&rms[i],
+                            &hc);
+        trusted++;
+      }
+      else
+      {
+        queue_rm (&rms[i],
+                  NULL,
+                  GNUNET_YES);
+      }
+    }
+    GNUNET_DISK_file_unmap (mh);
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Loaded %u verified revocations, verifying %llu others\n",
+              trusted,
+              (unsigned long long) (count - trusted));
+  /* append after the last complete entry */
+  if ((off_t) (count * sizeof (struct RevokeMessage)) !=
+      GNUNET_DISK_file_seek (revocation_db,
+                             count * sizeof (struct RevokeMessage),
+                             GNUNET_DISK_SEEK_SET))
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "seek",
+                              fn);
+    GNUNET_SCHEDULER_shutdown ();
+    GNUNET_free (fn);
+    return;
   }
   GNUNET_free (fn);
 
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
                                 &shutdown_task,
                                 NULL);
-  peers = GNUNET_CONTAINER_multipeermap_create (128,
-                                                GNUNET_YES);
   GNUNET_SERVER_add_handlers (srv, handlers);
+  GNUNET_SERVER_disconnect_notify (srv,
+                                   &handle_client_disconnect,
+                                   NULL);
    /* Connect to core service and register core handlers */
   core_api = GNUNET_CORE_connect (cfg,   /* Main configuration */
                                  NULL,       /* Closure passed to functions */
@@ -311,12 +311,32 @@ static char *file_name_view_log;
 static struct GNUNET_CONTAINER_MultiPeerMap *view;
 
 /**
- * An array containing the peers of the local view.
+ * The interned peers of the local view (same peers as in #view).
  *
- * This is created every time we send a pull reply if it has changed since the
- * last pull reply we sent.
+ * Kept up to date in place; memory is only ever grown.
  */
-static struct GNUNET_PeerIdentity *view_array;
+static GNUNET_PEER_Id *view_ids;
+
+/**
+ * Number of peers in #view_ids.
+ */
+static unsigned int view_ids_size;
+
+/**
+ * Allocated length of #view_ids.
+ */
+static unsigned int view_ids_capacity;
+
+/**
+ * Scratch array holding the previous view while #do_round builds the
+ * new one (swapped with #view_ids every update).
+ */
+static GNUNET_PEER_Id *old_view_ids;
+
+/**
+ * Allocated length of #old_view_ids.
+ */
+static unsigned int old_view_ids_capacity;
 
 
 /**
@@ -365,30 +385,34 @@ static struct GNUNET_TIME_Relative round_interval;
 
 
 /**
- * List to store peers received through pushes temporary.
- *
- * TODO -> multipeermap
+ * List to store (interned) peers received through pushes temporary.
  */
-static struct GNUNET_PeerIdentity *push_list;
+static GNUNET_PEER_Id *push_list;
 
 /**
  * Size of the push_list;
  */
 static unsigned int push_list_size;
-//size_t push_list_size;
 
 /**
- * List to store peers received through pulls temporary.
- *
- * TODO -> multipeermap
+ * Allocated length of the push_list.
  */
-static struct GNUNET_PeerIdentity *pull_list;
+static unsigned int push_list_capacity;
+
+/**
+ * List to store (interned) peers received through pulls temporary.
+ */
+static GNUNET_PEER_Id *pull_list;
 
 /**
  * Size of the pull_list;
  */
 static unsigned int pull_list_size;
-//size_t pull_list_size;
+
+/**
+ * Allocated length of the pull_list.
+ */
+static unsigned int pull_list_capacity;
 
 
 /**
@@ -594,6 +618,128 @@ in_arr (const struct GNUNET_PeerIdentity *array,
 }
 
 
+/**
+ * Check if peer is in an array of interned peers.
+ *
+ * @param ids the array
+ * @param size number of entries in @a ids
+ * @param peer the peer to look for
+ * @return #GNUNET_YES if @a peer is in @a ids
+ */
+static int
+in_id_arr (const GNUNET_PEER_Id *ids,
+           unsigned int size,
+           const struct GNUNET_PeerIdentity *peer)
+{
+  GNUNET_PEER_Id id;
+  unsigned int i;
+
+  if (0 == (id = GNUNET_PEER_search (peer)))
+    return GNUNET_NO; /* not interned, so in no array */
+  for (i = 0; i < size; i++)
+    if (id == ids[i])
+      return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Append an interned peer to an array, taking a reference to it.
+ * The array only ever grows so that it can be reused every round.
+ *
+ * @param ids the array
+ * @param size number of entries in @a ids
+ * @param capacity allocated length of @a ids
+ * @param id the peer to append
+ */
+static void
+id_arr_append (GNUNET_PEER_Id **ids,
+               unsigned int *size,
+               unsigned int *capacity,
+               GNUNET_PEER_Id id)
+{
+  if (*size == *capacity)
+    GNUNET_array_grow (*ids,
+                       *capacity,
+                       GNUNET_MAX (16, 2 * *capacity));
+  GNUNET_PEER_change_rc (id, 1);
+  (*ids)[(*size)++] = id;
+}
+
+
+/**
+ * Add a peer to an array of interned peers unless it is in there
+ * already.
+ *
+ * @param ids the array
+ * @param size number of entries in @a ids
+ * @param capacity allocated length of @a ids
+ * @param peer the peer to add
+ */
+static void
+id_arr_add (GNUNET_PEER_Id **ids,
+            unsigned int *size,
+            unsigned int *capacity,
+            const struct GNUNET_PeerIdentity *peer)
+{
+  GNUNET_PEER_Id id;
+
+  if (GNUNET_YES == in_id_arr (*ids, *size, peer))
+    return;
+  if (*size == *capacity)
+    GNUNET_array_grow (*ids,
+                       *capacity,
+                       GNUNET_MAX (16, 2 * *capacity));
+  id = GNUNET_PEER_intern (peer);
+  (*ids)[(*size)++] = id;
+}
+
+
+/**
+ * Remove a peer from an array of interned peers (not preserving the
+ * order) and drop the reference to it.
+ *
+ * @param ids the array
+ * @param size number of entries in @a ids
+ * @param peer the peer to remove
+ */
+static void
+id_arr_remove (GNUNET_PEER_Id *ids,
+               unsigned int *size,
+               const struct GNUNET_PeerIdentity *peer)
+{
+  GNUNET_PEER_Id id;
+  unsigned int i;
+
+  if (0 == (id = GNUNET_PEER_search (peer)))
+    return;
+  for (i = 0; i < *size; i++)
+  {
+    if (id != ids[i])
+      continue;
+    ids[i] = ids[--(*size)];
+    GNUNET_PEER_change_rc (id, -1);
+    return;
+  }
+}
+
+
+/**
+ * Drop the references to all peers in an array of interned peers and
+ * empty it (keeping its memory).
+ *
+ * @param ids the array
+ * @param size number of entries in @a ids
+ */
+static void
+id_arr_clear (GNUNET_PEER_Id *ids,
+              unsigned int *size)
+{
+  GNUNET_PEER_decrement_rcs (ids, *size);
+  *size = 0;
+}
+
+
 /**
  * Print peerlist to log.
  */
@@ -942,8 +1088,7 @@ T_relative_avg (const struct GNUNET_TIME_Relative *rel_array, uint32_t arr_size)
   void
 insert_in_pull_list (void *cls, const struct GNUNET_PeerIdentity *peer)
 {
-  if (GNUNET_NO == in_arr (pull_list, pull_list_size, peer))
-    GNUNET_array_append (pull_list, pull_list_size, *peer);
+  id_arr_add (&pull_list, &pull_list_size, &pull_list_capacity, peer);
 }
 
 /**
@@ -982,11 +1127,7 @@ insert_in_view (void *cls, const struct GNUNET_PeerIdentity *peer)
     LOG (GNUNET_ERROR_TYPE_WARNING,
         "Failed to put peer into view. (insert_in_view)\n");
   }
-  if (NULL != view_array)
-  {
-    GNUNET_free (view_array);
-    view_array = NULL;
-  }
+  id_arr_add (&view_ids, &view_ids_size, &view_ids_capacity, peer);
   if (GNUNET_NO == GNUNET_CONTAINER_multipeermap_contains (peer_map, peer))
     create_peer_ctx (peer);
   (void) get_channel (peer);
@@ -1240,14 +1381,19 @@ mq_notify_sent_cb (void *cls)
  * Send a PULL REPLY to @a peer_id
  *
  * @param peer_id the peer to send the reply to.
- * @param peer_ids the peers to send to @a peer_id
+ * @param peer_ids the peers to send to @a peer_id, NULL to send
+ *        the interned peers @a ids instead
+ * @param ids the interned peers to send if @a peer_ids is NULL
  * @param num_peer_ids the number of peers to send to @a peer_id
  */
 static void
 send_pull_reply (const struct GNUNET_PeerIdentity *peer_id,
                  const struct GNUNET_PeerIdentity *peer_ids,
+                 const GNUNET_PEER_Id *ids,
                  unsigned int num_peer_ids)
 {
+  struct GNUNET_PeerIdentity *out_ids;
+  unsigned int i;
   uint32_t send_size;
   struct GNUNET_MQ_Handle *mq;
   struct GNUNET_MQ_Envelope *ev;
@@ -1280,8 +1426,13 @@ send_pull_reply (const struct GNUNET_PeerIdentity *peer_id,
                             send_size * sizeof (struct GNUNET_PeerIdentity),
                             GNUNET_MESSAGE_TYPE_RPS_PP_PULL_REPLY);
   out_msg->num_peers = htonl (send_size);
-  memcpy (&out_msg[1], peer_ids,
-         send_size * sizeof (struct GNUNET_PeerIdentity));
+  out_ids = (struct GNUNET_PeerIdentity *) &out_msg[1];
+  if (NULL != peer_ids)
+    memcpy (out_ids, peer_ids,
+           send_size * sizeof (struct GNUNET_PeerIdentity));
+  else
+    for (i = 0; i < send_size; i++)
+      GNUNET_PEER_resolve (ids[i], &out_ids[i]);
 
   pending_msg = insert_pending_message (peer_id, ev, "PULL REPLY");
   GNUNET_MQ_notify_sent (ev,
@@ -1685,69 +1836,14 @@ handle_peer_push (void *cls,
   #endif /* ENABLE_MALICIOUS */
 
   /* Add the sending peer to the push_list */
-  if (GNUNET_NO == in_arr (push_list, push_list_size, peer))
-  {
-    GNUNET_assert (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (peer_map, peer));
-    GNUNET_array_append (push_list, push_list_size, *peer);
-  }
+  GNUNET_assert (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (peer_map, peer));
+  id_arr_add (&push_list, &push_list_size, &push_list_capacity, peer);
 
   GNUNET_CADET_receive_done (channel);
   return GNUNET_OK;
 }
 
 
-/**
- * Iterator over hash map entries.
- * Called from #generate_view_array and writes every peer id into #view_array.
- *
- * @param cls closure - the pointer to the counter
- * @param key current public key
- * @param value value in the hash map
- * @return #GNUNET_YES if we should continue to
- * iterate,
- * #GNUNET_NO if not.
- */
-static int
-dump_id_to_view_array (void *cls,
-                       const struct GNUNET_PeerIdentity *key,
-                       void *value)
-{
-  unsigned int *i = (unsigned int *) cls;
-
-  view_array[(*i)++] = *key;
-  return GNUNET_YES;
-}
-
-
-/**
- * Makes sure the view_array is filled with the peer ids currently in #view.
- * Called from within #do_round before sending pushes and pulls and from
- * #handle_peer_pull_request when a reply is sent.
- */
-static void
-generate_view_array (unsigned int view_size)
-{
-  unsigned int *i;
-  int ret;
-
-  if (NULL == view_array)
-  {
-    view_array = GNUNET_new_array (view_size,
-                                   struct GNUNET_PeerIdentity);
-    i = GNUNET_new (unsigned int);
-    *i = 0;
-
-    ret = GNUNET_CONTAINER_multipeermap_iterate (view,
-                                                 dump_id_to_view_array,
-                                                 i);
-    GNUNET_assert (view_size == ret);
-    GNUNET_assert (view_size == *i);
-
-    GNUNET_free (i);
-  }
-}
-
-
 /**
  * Handle PULL REQUEST request message from another peer.
  *
@@ -1765,7 +1861,6 @@ handle_peer_pull_request (void *cls,
     const struct GNUNET_MessageHeader *msg)
 {
   struct GNUNET_PeerIdentity *peer;
-  unsigned int view_size;
 
   peer = (struct GNUNET_PeerIdentity *)
     GNUNET_CADET_channel_get_info (channel,
@@ -1778,7 +1873,7 @@ handle_peer_pull_request (void *cls,
   if (1 == mal_type
       || 3 == mal_type)
   { /* Try to maximise representation */
-    send_pull_reply (peer, mal_peers, num_mal_peers);
+    send_pull_reply (peer, mal_peers, NULL, num_mal_peers);
     return GNUNET_OK;
   }
 
@@ -1786,16 +1881,13 @@ handle_peer_pull_request (void *cls,
   { /* Try to partition network */
     if (0 == GNUNET_CRYPTO_cmp_peer_identity (&attacked_peer, peer))
     {
-      send_pull_reply (peer, mal_peers, num_mal_peers);
+      send_pull_reply (peer, mal_peers, NULL, num_mal_peers);
     }
     return GNUNET_OK;
   }
   #endif /* ENABLE_MALICIOUS */
 
-  view_size = GNUNET_CONTAINER_multipeermap_size (view);
-  generate_view_array (view_size);
-
-  send_pull_reply (peer, view_array, view_size);
+  send_pull_reply (peer, NULL, view_ids, view_ids_size);
 
   GNUNET_CADET_receive_done (channel);
   return GNUNET_OK;
@@ -1923,8 +2015,8 @@ handle_peer_pull_reply (void *cls,
 
       if (GNUNET_YES == get_peer_flag (peer_ctx, VALID))
       {
-        if (GNUNET_NO == in_arr (pull_list, pull_list_size, &peers[i]))
-          GNUNET_array_append (pull_list, pull_list_size, peers[i]);
+        id_arr_add (&pull_list, &pull_list_size, &pull_list_capacity,
+                    &peers[i]);
       }
       else if (GNUNET_NO == insert_in_pull_list_scheduled (peer_ctx))
       {
@@ -2348,15 +2440,15 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
        "Printing view:\n");
   to_file (file_name_view_log,
            "___ new round ___");
-  view_size = GNUNET_CONTAINER_multipeermap_size (view);
-  generate_view_array (view_size);
+  view_size = view_ids_size;
+  GNUNET_assert (GNUNET_CONTAINER_multipeermap_size (view) == view_size);
   for (i = 0 ; i < view_size ; i++)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "\t%s\n", GNUNET_i2s (&view_array[i]));
+         "\t%s\n", GNUNET_i2s (GNUNET_PEER_resolve2 (view_ids[i])));
     to_file (file_name_view_log,
              "=%s\t(do round)",
-             GNUNET_i2s_full (&view_array[i]));
+             GNUNET_i2s_full (GNUNET_PEER_resolve2 (view_ids[i])));
   }
 
 
@@ -2374,7 +2466,7 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
          a_peers, alpha, view_size);
     for (i = 0; i < a_peers; i++)
     {
-      peer = view_array[permut[i]];
+      GNUNET_PEER_resolve (view_ids[permut[i]], &peer);
       if (0 != GNUNET_CRYPTO_cmp_peer_identity (&own_identity, &peer)) // TODO
       { // FIXME if this fails schedule/loop this for later
         send_push (&peer);
@@ -2395,7 +2487,7 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
         b_peers, beta, view_size);
     for (i = first_border; i < second_border; i++)
     {
-      peer = view_array[permut[i]];
+      GNUNET_PEER_resolve (view_ids[permut[i]], &peer);
       peer_ctx = get_peer_ctx (&peer);
       if (0 != GNUNET_CRYPTO_cmp_peer_identity (&own_identity, &peer) &&
           GNUNET_NO == get_peer_flag (peer_ctx, PULL_REPLY_PENDING)) // TODO
@@ -2419,19 +2511,26 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     LOG (GNUNET_ERROR_TYPE_DEBUG, "Update of the view.\n");
 
     uint32_t final_size;
-    uint32_t peers_to_clean_size;
-    struct GNUNET_PeerIdentity *peers_to_clean;
-
-    peers_to_clean = NULL;
-    peers_to_clean_size = 0;
-    GNUNET_array_grow (peers_to_clean, peers_to_clean_size, view_size);
-    memcpy (peers_to_clean,
-            view_array,
-            view_size * sizeof (struct GNUNET_PeerIdentity));
-
-    /* Seems like recreating is the easiest way of emptying the peermap */
-    GNUNET_CONTAINER_multipeermap_destroy (view);
-    view = GNUNET_CONTAINER_multipeermap_create (view_size, GNUNET_NO);
+    GNUNET_PEER_Id *tmp_ids;
+    GNUNET_PEER_Id id;
+    unsigned int tmp_capacity;
+    const struct GNUNET_PeerIdentity *id_peer;
+
+    /* Keep the old view (and our references to its peers) to clean
+     * up the peers that drop out of it; reuse the scratch array for
+     * the new view. */
+    tmp_ids = old_view_ids;
+    tmp_capacity = old_view_ids_capacity;
+    old_view_ids = view_ids;
+    old_view_ids_capacity = view_ids_capacity;
+    view_ids = tmp_ids;
+    view_ids_capacity = tmp_capacity;
+    view_ids_size = 0;
+
+    /* Empty the peermap in place */
+    for (i = 0; i < view_size; i++)
+      GNUNET_CONTAINER_multipeermap_remove_all (view,
+          GNUNET_PEER_resolve2 (old_view_ids[i]));
     to_file (file_name_view_log,
              "--- emptied ---");
 
@@ -2443,20 +2542,22 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     final_size    = second_border +
       ceil ((1 - (alpha + beta)) * sampler_size_est_need);
 
-    GNUNET_array_grow (view_array, view_size, second_border);
-
     /* Update view with peers received through PUSHes */
     permut = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_STRONG,
                                            push_list_size);
     for (i = 0; i < first_border; i++)
     {
-      view_array[i] = push_list[permut[i]];
-      GNUNET_CONTAINER_multipeermap_put (view, &push_list[permut[i]], NULL,
+      id = push_list[permut[i]];
+      id_peer = GNUNET_PEER_resolve2 (id);
+      if (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (view, id_peer))
+        continue;
+      GNUNET_CONTAINER_multipeermap_put (view, id_peer, NULL,
           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+      id_arr_append (&view_ids, &view_ids_size, &view_ids_capacity, id);
 
       to_file (file_name_view_log,
                "+%s\t(push list)",
-               GNUNET_i2s_full (&view_array[i]));
+               GNUNET_i2s_full (id_peer));
       // TODO change the peer_flags accordingly
     }
     GNUNET_free (permut);
@@ -2467,15 +2568,17 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
                                            pull_list_size);
     for (i = first_border; i < second_border; i++)
     {
-      view_array[i] = pull_list[permut[i - first_border]];
-      GNUNET_CONTAINER_multipeermap_put (view,
-          &pull_list[permut[i - first_border]],
-          NULL,
+      id = pull_list[permut[i - first_border]];
+      id_peer = GNUNET_PEER_resolve2 (id);
+      if (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (view, id_peer))
+        continue;
+      GNUNET_CONTAINER_multipeermap_put (view, id_peer, NULL,
           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+      id_arr_append (&view_ids, &view_ids_size, &view_ids_capacity, id);
 
       to_file (file_name_view_log,
                "+%s\t(pull list)",
-               GNUNET_i2s_full (&view_array[i]));
+               GNUNET_i2s_full (id_peer));
       // TODO change the peer_flags accordingly
     }
     GNUNET_free (permut);
@@ -2489,20 +2592,18 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     num_hist_update_tasks = final_size - second_border;
     // TODO change the peer_flags accordingly
 
-    for (i = 0; i < view_size; i++)
-      rem_from_list (&peers_to_clean, &peers_to_clean_size, &view_array[i]);
-
     /* Clean peers that were removed from the view */
-    for (i = 0; i < peers_to_clean_size; i++)
+    for (i = 0; i < view_size; i++)
     {
+      id_peer = GNUNET_PEER_resolve2 (old_view_ids[i]);
+      if (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (view, id_peer))
+        continue;
       to_file (file_name_view_log,
                "-%s",
-               GNUNET_i2s_full (&peers_to_clean[i]));
-      peer_clean (&peers_to_clean[i]);
+               GNUNET_i2s_full (id_peer));
+      peer_clean (id_peer);
     }
-
-    GNUNET_array_grow (peers_to_clean, peers_to_clean_size, 0);
-    peers_to_clean = NULL;
+    GNUNET_PEER_decrement_rcs (old_view_ids, view_size);
   }
   else
   {
@@ -2521,26 +2622,28 @@ do_round (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   /* Update samplers */
   for (i = 0; i < push_list_size; i++)
   {
+    GNUNET_PEER_resolve (push_list[i], &peer);
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Updating with peer %s from push list\n",
-         GNUNET_i2s (&push_list[i]));
-    insert_in_sampler (NULL, &push_list[i]);
-    peer_clean (&push_list[i]); /* This cleans only if it is not in the view */
+         GNUNET_i2s (&peer));
+    insert_in_sampler (NULL, &peer);
+    peer_clean (&peer); /* This cleans only if it is not in the view */
   }
 
   for (i = 0; i < pull_list_size; i++)
   {
+    GNUNET_PEER_resolve (pull_list[i], &peer);
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Updating with peer %s from pull list\n",
-         GNUNET_i2s (&pull_list[i]));
-    insert_in_sampler (NULL, &pull_list[i]);
-    peer_clean (&pull_list[i]); /* This cleans only if it is not in the view */
+         GNUNET_i2s (&peer));
+    insert_in_sampler (NULL, &peer);
+    peer_clean (&peer); /* This cleans only if it is not in the view */
   }
 
 
-  /* Empty push/pull lists */
-  GNUNET_array_grow (push_list, push_list_size, 0);
-  GNUNET_array_grow (pull_list, pull_list_size, 0);
+  /* Empty push/pull lists (keeping their memory for the next round) */
+  id_arr_clear (push_list, &push_list_size);
+  id_arr_clear (pull_list, &pull_list_size);
 
   struct GNUNET_TIME_Relative time_next_round;
 
@@ -2652,18 +2755,12 @@ peer_remove_cb (void *cls, const struct GNUNET_PeerIdentity *key, void *value)
         "-%s\t(cleanup channel, other peer)",
         GNUNET_i2s_full (key));
     GNUNET_CONTAINER_multipeermap_remove_all (view, key);
-    if (NULL != view_array)
-    {
-      GNUNET_free (view_array);
-      view_array = NULL;
-    }
+    id_arr_remove (view_ids, &view_ids_size, key);
   }
 
   /* Remove from push and pull lists */
-  if (GNUNET_YES == in_arr (push_list, push_list_size, key))
-    rem_from_list (&push_list, &push_list_size, key);
-  if (GNUNET_YES == in_arr (pull_list, pull_list_size, key))
-    rem_from_list (&pull_list, &pull_list_size, key);
+  id_arr_remove (push_list, &push_list_size, key);
+  id_arr_remove (pull_list, &pull_list_size, key);
 
   /* Cancle messages that have not been sent yet */
   while (NULL != peer_ctx->pending_messages_head)
@@ -2728,8 +2825,8 @@ peer_clean (const struct GNUNET_PeerIdentity *peer)
 
   if ( (0 == RPS_sampler_count_id (prot_sampler, peer)) &&
        (GNUNET_NO  == GNUNET_CONTAINER_multipeermap_contains (view, peer)) &&
-       (GNUNET_NO  == in_arr (push_list, push_list_size, peer)) &&
-       (GNUNET_NO  == in_arr (pull_list, pull_list_size, peer)) &&
+       (GNUNET_NO  == in_id_arr (push_list, push_list_size, peer)) &&
+       (GNUNET_NO  == in_id_arr (pull_list, pull_list_size, peer)) &&
        (GNUNET_YES == GNUNET_CONTAINER_multipeermap_contains (peer_map, peer)) )
   {
     peer_ctx = get_peer_ctx (peer);
@@ -2789,8 +2886,13 @@ shutdown_task (void *cls,
   GNUNET_CONTAINER_multipeermap_destroy (peer_map);
   GNUNET_CONTAINER_multipeermap_destroy (view);
   view = NULL;
-  GNUNET_array_grow (push_list, push_list_size, 0);
-  GNUNET_array_grow (pull_list, pull_list_size, 0);
+  id_arr_clear (view_ids, &view_ids_size);
+  id_arr_clear (push_list, &push_list_size);
+  id_arr_clear (pull_list, &pull_list_size);
+  GNUNET_array_grow (view_ids, view_ids_capacity, 0);
+  GNUNET_array_grow (old_view_ids, old_view_ids_capacity, 0);
+  GNUNET_array_grow (push_list, push_list_capacity, 0);
+  GNUNET_array_grow (pull_list, pull_list_capacity, 0);
   #ifdef ENABLE_MALICIOUS
   struct AttackedPeer *tmp_att_peer;
   GNUNET_array_grow (mal_peers, num_mal_peers, 0);
@@ -3127,12 +3229,20 @@ run (void *cls,
 
   prot_sampler =   RPS_sampler_init     (sampler_size_est_need, max_round_interval);
   client_sampler = RPS_sampler_mod_init (sampler_size_est_need, max_round_interval);
+  if (GNUNET_YES ==
+      GNUNET_CONFIGURATION_get_value_yesno (cfg, "RPS", "FAST_SAMPLER"))
+  {
+    RPS_sampler_set_fast_hash (prot_sampler, GNUNET_YES);
+    RPS_sampler_set_fast_hash (client_sampler, GNUNET_YES);
+  }
 
   /* Initialise push and pull maps */
   push_list = NULL;
   push_list_size = 0;
+  push_list_capacity = 0;
   pull_list = NULL;
   pull_list_size = 0;
+  pull_list_capacity = 0;
 
 
   num_hist_update_tasks = 0;
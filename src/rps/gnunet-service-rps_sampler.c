@@ -37,6 +37,11 @@
 
 #define LOG(kind, ...) GNUNET_log_from(kind,"rps-sampler",__VA_ARGS__)
 
+/**
+ * Number of sampler elements the fast update compares in one go.
+ */
+#define FAST_BLOCK_SIZE 64
+
 
 // multiple 'clients'?
 
@@ -167,6 +172,30 @@ struct RPS_Sampler
   struct RPS_SamplerRequestHandle *req_handle_head;
   struct RPS_SamplerRequestHandle *req_handle_tail;
 
+  /**
+   * #GNUNET_YES if the sampler elements use the fast min-wise
+   * functions instead of one HMAC per element (see
+   * #RPS_sampler_set_fast_hash()).
+   */
+  int fast_hash;
+
+  /**
+   * Key of the HMAC computed once per PeerID in fast mode.
+   */
+  struct GNUNET_CRYPTO_AuthKey fast_key;
+
+  /**
+   * Per-element keys of the fast min-wise functions, one for
+   * each sampler element (only in fast mode).
+   */
+  uint64_t *fast_keys;
+
+  /**
+   * Per-element minimum hash value seen so far, `UINT64_MAX` if the
+   * element is empty (only in fast mode).
+   */
+  uint64_t *fast_mins;
+
   #ifdef TO_FILE
   /**
    * File name to log to
@@ -294,6 +323,74 @@ RPS_sampler_get_size (struct RPS_Sampler *sampler)
 }
 
 
+/**
+ * Mix a 64-bit value (finaliser of MurmurHash3).  A bijection that
+ * turns each input bit into an avalanche over the whole output.
+ *
+ * @param x value to mix
+ * @return mixed value
+ */
+static inline uint64_t
+mix64 (uint64_t x)
+{
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdLLU;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53LLU;
+  x ^= x >> 33;
+  return x;
+}
+
+
+/**
+ * Choose a new fast min-wise function for the sampler element at
+ * @a index and mark it as empty.
+ *
+ * @param sampler the sampler
+ * @param index index of the sampler element
+ */
+static void
+fast_elem_reinit (struct RPS_Sampler *sampler,
+                  uint32_t index)
+{
+  sampler->fast_keys[index] =
+    GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_STRONG,
+                              UINT64_MAX);
+  sampler->fast_mins[index] = UINT64_MAX;
+}
+
+
+/**
+ * Resize the arrays of the fast min-wise functions after the
+ * sampler elements were resized from @a old_size.
+ *
+ * @param sampler the sampler
+ * @param old_size previous number of sampler elements
+ */
+static void
+fast_resize (struct RPS_Sampler *sampler,
+             unsigned int old_size)
+{
+  unsigned int new_size = sampler->sampler_size;
+  uint32_t i;
+
+  if (0 == new_size)
+  {
+    GNUNET_free_non_null (sampler->fast_keys);
+    GNUNET_free_non_null (sampler->fast_mins);
+    sampler->fast_keys = NULL;
+    sampler->fast_mins = NULL;
+    return;
+  }
+  sampler->fast_keys = GNUNET_realloc (sampler->fast_keys,
+                                       new_size * sizeof (uint64_t));
+  sampler->fast_mins = GNUNET_realloc (sampler->fast_mins,
+                                       new_size * sizeof (uint64_t));
+  for (i = old_size; i < new_size; i++)
+    fast_elem_reinit (sampler, i);
+}
+
+
 /**
  * Grow or shrink the size of the sampler.
  *
@@ -372,6 +469,8 @@ sampler_resize (struct RPS_Sampler *sampler, unsigned int new_size)
   }
 
   GNUNET_assert (sampler->sampler_size == new_size);
+  if (GNUNET_YES == sampler->fast_hash)
+    fast_resize (sampler, old_size);
 }
 
 
@@ -467,6 +566,93 @@ RPS_sampler_mod_init (size_t init_size,
 }
 
 
+/**
+ * Switch the sampler elements between one HMAC per element and
+ * PeerID (the default) and the fast min-wise functions.
+ *
+ * The fast functions compute a single HMAC with a sampler-wide secret
+ * key per PeerID and derive each element's value by mixing it with a
+ * secret per-element key.  The per-element state is kept in
+ * contiguous arrays so that an update is a tight loop over them.
+ * All sampler elements are emptied.
+ *
+ * @param sampler the sampler
+ * @param fast #GNUNET_YES to use the fast functions
+ */
+void
+RPS_sampler_set_fast_hash (struct RPS_Sampler *sampler,
+                           int fast)
+{
+  uint32_t i;
+
+  for (i = 0 ; i < sampler->sampler_size ; i++)
+    RPS_sampler_elem_reinit (sampler->sampler_elements[i]);
+  sampler->fast_hash = fast;
+  GNUNET_free_non_null (sampler->fast_keys);
+  GNUNET_free_non_null (sampler->fast_mins);
+  sampler->fast_keys = NULL;
+  sampler->fast_mins = NULL;
+  if (GNUNET_YES != fast)
+    return;
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_STRONG,
+                              &sampler->fast_key.key,
+                              sizeof (sampler->fast_key.key));
+  fast_resize (sampler, 0);
+}
+
+
+/**
+ * Update all sampler elements using the fast min-wise functions.
+ *
+ * @param sampler the sampler to update.
+ * @param id the PeerID that is put in the sampler
+ */
+static void
+sampler_fast_update (struct RPS_Sampler *sampler,
+                     const struct GNUNET_PeerIdentity *id)
+{
+  struct GNUNET_HashCode id_hash;
+  struct RPS_SamplerElement *s_elem;
+  const uint64_t *keys = sampler->fast_keys;
+  uint64_t *mins = sampler->fast_mins;
+  uint64_t hv[FAST_BLOCK_SIZE];
+  uint64_t fp;
+  uint32_t off;
+  uint32_t n;
+  uint32_t j;
+  int changed;
+
+  GNUNET_CRYPTO_hmac (&sampler->fast_key,
+                      id,
+                      sizeof (struct GNUNET_PeerIdentity),
+                      &id_hash);
+  memcpy (&fp, &id_hash, sizeof (fp));
+  for (off = 0 ; off < sampler->sampler_size ; off += FAST_BLOCK_SIZE)
+  {
+    n = GNUNET_MIN (FAST_BLOCK_SIZE, sampler->sampler_size - off);
+    /* branch-free, so that the compiler can vectorise it */
+    changed = 0;
+    for (j = 0 ; j < n ; j++)
+    {
+      hv[j] = mix64 (fp ^ keys[off + j]);
+      changed |= (hv[j] < mins[off + j]);
+    }
+    if (0 == changed)
+      continue; /* the common case once the sampler converged */
+    for (j = 0 ; j < n ; j++)
+    {
+      if (hv[j] >= mins[off + j])
+        continue;
+      mins[off + j] = hv[j];
+      s_elem = sampler->sampler_elements[off + j];
+      s_elem->peer_id = *id;
+      s_elem->is_empty = NOT_EMPTY;
+      s_elem->num_change++;
+    }
+  }
+}
+
+
 /**
  * A fuction to update every sampler in the given list
  *
@@ -483,6 +669,11 @@ RPS_sampler_update (struct RPS_Sampler *sampler,
            "Got %s",
            GNUNET_i2s_full (id));
 
+  if (GNUNET_YES == sampler->fast_hash)
+  {
+    sampler_fast_update (sampler, id);
+    return;
+  }
   for (i = 0 ; i < sampler->sampler_size ; i++)
   {
     RPS_sampler_elem_next (sampler->sampler_elements[i],
@@ -517,6 +708,8 @@ RPS_sampler_reinitialise_by_value (struct RPS_Sampler *sampler,
       to_file (trash_entry->file_name,
                "--- non-active");
       RPS_sampler_elem_reinit (sampler->sampler_elements[i]);
+      if (GNUNET_YES == sampler->fast_hash)
+        fast_elem_reinit (sampler, i);
     }
   }
 }
@@ -96,6 +96,19 @@ RPS_sampler_mod_init (size_t init_size,
                       struct GNUNET_TIME_Relative max_round_interval);
 
 
+/**
+ * Switch the sampler elements between one HMAC per element and
+ * PeerID (the default) and the fast min-wise functions, which need
+ * only one HMAC per PeerID.  All sampler elements are emptied.
+ *
+ * @param sampler the sampler
+ * @param fast #GNUNET_YES to use the fast functions
+ */
+void
+RPS_sampler_set_fast_hash (struct RPS_Sampler *sampler,
+                           int fast);
+
+
 /**
  * A fuction to update every sampler in the given list
  *
@@ -0,0 +1,107 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file rps/perf_rps_sampler.c
+ * @brief measure performance of updating the RPS sampler with the
+ *        HMAC and the fast min-wise functions
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet-service-rps_sampler.h"
+#include <gauger.h>
+
+/**
+ * Number of sampler elements.
+ */
+#define SAMPLER_SIZE 1000
+
+/**
+ * Number of distinct PeerIDs fed to the sampler.
+ */
+#define NUM_PEERS 256
+
+/**
+ * Number of updates to measure.
+ */
+#define NUM_UPDATES 1024
+
+
+/**
+ * Feed #NUM_UPDATES PeerIDs to a sampler and report the time taken.
+ *
+ * @param ids PeerIDs to use
+ * @param fast #GNUNET_YES to use the fast min-wise functions
+ * @param label what to report
+ */
+static void
+perf_update (const struct GNUNET_PeerIdentity *ids,
+             int fast,
+             const char *label)
+{
+  struct RPS_Sampler *sampler;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative delta;
+  unsigned int i;
+
+  sampler = RPS_sampler_init (SAMPLER_SIZE,
+                              GNUNET_TIME_UNIT_SECONDS);
+  RPS_sampler_set_fast_hash (sampler,
+                             fast);
+  start = GNUNET_TIME_absolute_get ();
+  for (i = 0; i < NUM_UPDATES; i++)
+    RPS_sampler_update (sampler,
+                        &ids[i % NUM_PEERS]);
+  delta = GNUNET_TIME_absolute_get_duration (start);
+  printf ("%s: %u updates of %u elements took %s\n",
+          label,
+          NUM_UPDATES,
+          SAMPLER_SIZE,
+          GNUNET_STRINGS_relative_time_to_string (delta,
+                                                  GNUNET_YES));
+  GAUGER ("RPS",
+          label,
+          NUM_UPDATES / (1 + delta.rel_value_us / 1000LL),
+          "updates/ms");
+  RPS_sampler_destroy (sampler);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_PeerIdentity ids[NUM_PEERS];
+
+  GNUNET_log_setup ("perf-rps-sampler",
+                    "WARNING",
+                    NULL);
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              ids,
+                              sizeof (ids));
+  perf_update (ids,
+               GNUNET_NO,
+               "Sampler update (HMAC)");
+  perf_update (ids,
+               GNUNET_YES,
+               "Sampler update (fast)");
+  return 0;
+}
+
+/* end of perf_rps_sampler.c */
@@ -0,0 +1,1202 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2013, 2014, 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+ */
+/**
+ * @file scalarproduct/gnunet-service-scalarproduct-ecc_alice.c
+ * @brief scalarproduct service implementation using ECC instead of
+ *        Paillier; the result must be small enough to be found by
+ *        the discrete logarithm over a precomputed table
+ * @author Christian M. Fuchs
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <limits.h>
+#include <gcrypt.h>
+#include "gnunet_util_lib.h"
+#include "gnunet_core_service.h"
+#include "gnunet_cadet_service.h"
+#include "gnunet_applications.h"
+#include "gnunet_protocols.h"
+#include "gnunet_scalarproduct_service.h"
+#include "gnunet_set_service.h"
+#include "scalarproduct.h"
+#include "gnunet-service-scalarproduct-ecc.h"
+#include "gnunet-service-scalarproduct_common.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "scalarproduct-alice", __VA_ARGS__)
+
+/**
+ * Maximum allowed result value for the scalarproduct computation.
+ * DLOG will fail if the result is bigger.  At 1 million, the
+ * precomputation takes about 2s on a fast machine.
+ */
+#define MAX_RESULT (1024 * 1024)
+
+/**
+ * How many values should DLOG store in memory (determines baseline
+ * RAM consumption, roughly 100 bytes times the value given here).
+ * Should be about SQRT (MAX_RESULT), larger values will make the
+ * online computation faster.
+ */
+#define MAX_RAM (1024)
+
+/**
+ * How many elements are encrypted by one job in the crypto
+ * offload pool.
+ */
+#define ELEMENTS_PER_JOB 256
+
+
+/**
+ * A scalarproduct session which tracks
+ * a request form the client to our final response.
+ */
+struct AliceServiceSession;
+
+
+/**
+ * Encryption of a range of elements in the crypto offload pool.
+ */
+struct EncryptJob
+{
+
+  /**
+   * Session the elements belong to.
+   */
+  struct AliceServiceSession *s;
+
+  /**
+   * Handle for the job, NULL once it is done.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Offset of the first element to encrypt.
+   */
+  uint32_t off;
+
+  /**
+   * Number of elements to encrypt.
+   */
+  uint32_t count;
+
+};
+
+
+/**
+ * A scalarproduct session which tracks
+ * a request form the client to our final response.
+ */
+struct AliceServiceSession
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct AliceServiceSession *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct AliceServiceSession *prev;
+
+  /**
+   * (hopefully) unique transaction ID
+   */
+  struct GNUNET_HashCode session_id;
+
+  /**
+   * Alice or Bob's peerID
+   */
+  struct GNUNET_PeerIdentity peer;
+
+  /**
+   * The client this request is related to.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * The message queue for the client.
+   */
+  struct GNUNET_MQ_Handle *client_mq;
+
+  /**
+   * The message queue for CADET.
+   */
+  struct GNUNET_MQ_Handle *cadet_mq;
+
+  /**
+   * all non-0-value'd elements transmitted to us.
+   * Values are of type `struct GNUNET_SCALARPRODUCT_Element *`
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *intersected_elements;
+
+  /**
+   * Set of elements for which will conduction an intersection.
+   * the resulting elements are then used for computing the scalar product.
+   */
+  struct GNUNET_SET_Handle *intersection_set;
+
+  /**
+   * Set of elements for which will conduction an intersection.
+   * the resulting elements are then used for computing the scalar product.
+   */
+  struct GNUNET_SET_OperationHandle *intersection_op;
+
+  /**
+   * Handle to Alice's Intersection operation listening for Bob
+   */
+  struct GNUNET_SET_ListenHandle *intersection_listen;
+
+  /**
+   * channel-handle associated with our cadet handle
+   */
+  struct GNUNET_CADET_Channel *channel;
+
+  /**
+   * a(Alice), sorted array by key of length @e used_element_count.
+   */
+  struct MpiElement *sorted_elements;
+
+  /**
+   * Encrypted values (g_i, h_i) for all elements of
+   * @e sorted_elements, filled in by the @e jobs.
+   */
+  struct GNUNET_CRYPTO_EccPoint *payload;
+
+  /**
+   * Jobs encrypting @e sorted_elements into @e payload.
+   */
+  struct EncryptJob *jobs;
+
+  /**
+   * Our secret "a" for this session.
+   */
+  gcry_mpi_t a;
+
+  /**
+   * The computed scalar
+   */
+  gcry_mpi_t product;
+
+  /**
+   * Length of the @e jobs array.
+   */
+  unsigned int num_jobs;
+
+  /**
+   * Number of @e jobs that have not finished yet.
+   */
+  unsigned int jobs_pending;
+
+  /**
+   * How many elements we were supplied with from the client (total
+   * count before intersection).
+   */
+  uint32_t total;
+
+  /**
+   * How many elements actually are used for the scalar product.
+   * Size of the array in @e sorted_elements.
+   */
+  uint32_t used_element_count;
+
+  /**
+   * Already transferred elements from client to us.
+   * Less or equal than @e total.
+   */
+  uint32_t client_received_element_count;
+
+  /**
+   * State of this session.   In
+   * #GNUNET_SCALARPRODUCT_STATUS_ACTIVE while operation is
+   * ongoing, afterwards in #GNUNET_SCALARPRODUCT_STATUS_SUCCESS or
+   * #GNUNET_SCALARPRODUCT_STATUS_FAILURE.
+   */
+  enum GNUNET_SCALARPRODUCT_ResponseStatus status;
+
+  /**
+   * Flag to prevent recursive calls to #destroy_service_session() from
+   * doing harm.
+   */
+  int in_destroy;
+
+};
+
+
+/**
+ * GNUnet configuration handle
+ */
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+/**
+ * Context for DLOG operations on a curve.
+ */
+static struct GNUNET_CRYPTO_EccDlogContext *edc;
+
+/**
+ * Handle to the CADET service.
+ */
+static struct GNUNET_CADET_Handle *my_cadet;
+
+/**
+ * Head of DLL of all our sessions.
+ */
+static struct AliceServiceSession *s_head;
+
+/**
+ * Tail of DLL of all our sessions.
+ */
+static struct AliceServiceSession *s_tail;
+
+
+/**
+ * Destroy session state, we are done with it.
+ *
+ * @param s the session to free elements from
+ */
+static void
+destroy_service_session (struct AliceServiceSession *s)
+{
+  unsigned int i;
+
+  if (GNUNET_YES == s->in_destroy)
+    return;
+  s->in_destroy = GNUNET_YES;
+  GNUNET_CONTAINER_DLL_remove (s_head,
+                               s_tail,
+                               s);
+  /* workers may still be using our arrays, stop them first */
+  for (i=0;i<s->num_jobs;i++)
+    if (NULL != s->jobs[i].job)
+    {
+      GNUNET_CRYPTO_offload_cancel (s->jobs[i].job);
+      s->jobs[i].job = NULL;
+    }
+  GNUNET_free_non_null (s->jobs);
+  s->jobs = NULL;
+  if (NULL != s->client_mq)
+  {
+    GNUNET_MQ_destroy (s->client_mq);
+    s->client_mq = NULL;
+  }
+  if (NULL != s->cadet_mq)
+  {
+    GNUNET_MQ_destroy (s->cadet_mq);
+    s->cadet_mq = NULL;
+  }
+  if (NULL != s->client)
+  {
+    GNUNET_SERVER_client_set_user_context (s->client,
+                                           NULL);
+    GNUNET_SERVER_client_disconnect (s->client);
+    s->client = NULL;
+  }
+  if (NULL != s->channel)
+  {
+    GNUNET_CADET_channel_destroy (s->channel);
+    s->channel = NULL;
+  }
+  if (NULL != s->intersected_elements)
+  {
+    GSP_free_elements (s->intersected_elements);
+    s->intersected_elements = NULL;
+  }
+  if (NULL != s->intersection_listen)
+  {
+    GNUNET_SET_listen_cancel (s->intersection_listen);
+    s->intersection_listen = NULL;
+  }
+  if (NULL != s->intersection_op)
+  {
+    GNUNET_SET_operation_cancel (s->intersection_op);
+    s->intersection_op = NULL;
+  }
+  if (NULL != s->intersection_set)
+  {
+    GNUNET_SET_destroy (s->intersection_set);
+    s->intersection_set = NULL;
+  }
+  GSP_free_sorted_elements (s->sorted_elements,
+                            s->used_element_count);
+  s->sorted_elements = NULL;
+  GNUNET_free_non_null (s->payload);
+  s->payload = NULL;
+  if (NULL != s->a)
+  {
+    gcry_mpi_release (s->a);
+    s->a = NULL;
+  }
+  if (NULL != s->product)
+  {
+    gcry_mpi_release (s->product);
+    s->product = NULL;
+  }
+  GNUNET_free (s);
+}
+
+
+/**
+ * Notify the client that the session has failed.  A message gets sent
+ * to Alice's client if we encountered any error.
+ *
+ * @param session the associated client session to fail or succeed
+ */
+static void
+prepare_client_end_notification (struct AliceServiceSession *session)
+{
+  GSP_send_client_end (session->client_mq,
+                       &session->session_id,
+                       session->status);
+}
+
+
+/**
+ * Prepare the final (positive) response we will send to Alice's
+ * client.
+ *
+ * @param s the session associated with our client.
+ */
+static void
+transmit_client_response (struct AliceServiceSession *s)
+{
+  GSP_send_client_result (s->client_mq,
+                          &s->session_id,
+                          s->product);
+  if (NULL != s->product)
+  {
+    gcry_mpi_release (s->product);
+    s->product = NULL;
+  }
+}
+
+
+
+/**
+ * Function called whenever a channel is destroyed.  Should clean up
+ * any associated state.
+ *
+ * It must NOT call #GNUNET_CADET_channel_destroy() on the channel.
+ *
+ * @param cls closure (set from #GNUNET_CADET_connect())
+ * @param channel connection to the other end (henceforth invalid)
+ * @param channel_ctx place where local state associated
+ *                   with the channel is stored
+ */
+static void
+cb_channel_destruction (void *cls,
+                        const struct GNUNET_CADET_Channel *channel,
+                        void *channel_ctx)
+{
+  struct AliceServiceSession *s = channel_ctx;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Peer disconnected, terminating session %s with peer %s\n",
+              GNUNET_h2s (&s->session_id),
+              GNUNET_i2s (&s->peer));
+  if (NULL != s->cadet_mq)
+  {
+    GNUNET_MQ_destroy (s->cadet_mq);
+    s->cadet_mq = NULL;
+  }
+  s->channel = NULL;
+  if (GNUNET_SCALARPRODUCT_STATUS_ACTIVE == s->status)
+  {
+    /* We didn't get an answer yet, fail with error */
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+  }
+}
+
+
+/**
+ * Compute our scalar product, done by Alice.  Bob sent us
+ * g^{sum b_i r_i} and g^{sum b_i (r_i a + a_i)}, so subtracting
+ * a times the former from the latter leaves g^{sum a_i b_i}.
+ *
+ * @param s the session associated with this computation
+ * @param msg Bob's reply
+ * @return product as MPI, NULL if Bob's reply is malformed or the
+ *         result is out of the range of our DLOG table
+ */
+static gcry_mpi_t
+compute_scalar_product (struct AliceServiceSession *s,
+                        const struct EccBobCryptodataMessage *msg)
+{
+  gcry_mpi_point_t g_i_b_i;
+  gcry_mpi_point_t h_i_b_i;
+  gcry_mpi_point_t tmp;
+  gcry_mpi_point_t p;
+  gcry_mpi_t a_inv;
+  gcry_mpi_t ret;
+  int ai_bi;
+
+  g_i_b_i = GNUNET_CRYPTO_ecc_bin_to_point (edc,
+                                            &msg->prod_g_i_b_i);
+  h_i_b_i = GNUNET_CRYPTO_ecc_bin_to_point (edc,
+                                            &msg->prod_h_i_b_i);
+  if ( (NULL == g_i_b_i) ||
+       (NULL == h_i_b_i) )
+  {
+    GNUNET_break_op (0);
+    if (NULL != g_i_b_i)
+      GNUNET_CRYPTO_ecc_free (g_i_b_i);
+    if (NULL != h_i_b_i)
+      GNUNET_CRYPTO_ecc_free (h_i_b_i);
+    return NULL;
+  }
+  a_inv = gcry_mpi_new (0);
+  gcry_mpi_neg (a_inv, s->a);
+  tmp = GNUNET_CRYPTO_ecc_pmul_mpi (edc,
+                                    g_i_b_i,
+                                    a_inv);
+  gcry_mpi_release (a_inv);
+  p = GNUNET_CRYPTO_ecc_add (edc,
+                             h_i_b_i,
+                             tmp);
+  GNUNET_CRYPTO_ecc_free (tmp);
+  GNUNET_CRYPTO_ecc_free (g_i_b_i);
+  GNUNET_CRYPTO_ecc_free (h_i_b_i);
+  ai_bi = GNUNET_CRYPTO_ecc_dlog (edc,
+                                  p);
+  GNUNET_CRYPTO_ecc_free (p);
+  if (MAX_RESULT == ai_bi)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Scalar product is out of range for the DLOG (limit: %u)\n",
+         (unsigned int) MAX_RESULT);
+    return NULL;
+  }
+  ret = gcry_mpi_new (0);
+  if (ai_bi > 0)
+    gcry_mpi_set_ui (ret, ai_bi);
+  else
+    gcry_mpi_sub_ui (ret, ret, - ai_bi);
+  return ret;
+}
+
+
+/**
+ * Handle a response we got from another service we wanted to
+ * calculate a scalarproduct with.
+ *
+ * @param cls closure (set from #GNUNET_CADET_connect)
+ * @param channel connection to the other end
+ * @param channel_ctx place to store local state associated with the channel
+ * @param message the actual message
+ * @return #GNUNET_OK to keep the connection open,
+ *         #GNUNET_SYSERR to close it (we are done)
+ */
+static int
+handle_bobs_cryptodata_message (void *cls,
+                                struct GNUNET_CADET_Channel *channel,
+                                void **channel_ctx,
+                                const struct GNUNET_MessageHeader *message)
+{
+  struct AliceServiceSession *s = *channel_ctx;
+  const struct EccBobCryptodataMessage *msg;
+
+  if (NULL == s)
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  msg = (const struct EccBobCryptodataMessage *) message;
+  if (2 != ntohl (msg->contained_element_count))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if ( (NULL == s->sorted_elements) ||
+       (0 != s->jobs_pending) )
+  {
+    /* we're not ready yet, how can Bob be? */
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  if (s->total != s->client_received_element_count)
+  {
+    /* we're not ready yet, how can Bob be? */
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Received crypto values from Bob\n");
+  GNUNET_CADET_receive_done (s->channel);
+  s->product = compute_scalar_product (s,
+                                       msg);
+  if (NULL == s->product)
+  {
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return GNUNET_OK;
+  }
+  transmit_client_response (s);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Maximum number of elements we can put into a single cryptodata
+ * message
+ */
+#define ELEMENT_CAPACITY ((GNUNET_CONSTANTS_MAX_CADET_MESSAGE_SIZE - 1 - sizeof (struct EccAliceCryptodataMessage)) / (2 * sizeof (struct GNUNET_CRYPTO_EccPoint)))
+
+
+/**
+ * Send the cryptographic data from Alice to Bob, once all
+ * encryption jobs are done.
+ *
+ * @param s the associated service session
+ */
+static void
+transmit_alices_cryptodata_message (struct AliceServiceSession *s)
+{
+  struct EccAliceCryptodataMessage *msg;
+  struct GNUNET_MQ_Envelope *e;
+  uint32_t todo_count;
+  uint32_t off;
+
+  off = 0;
+  while (off < s->used_element_count)
+  {
+    todo_count = s->used_element_count - off;
+    if (todo_count > ELEMENT_CAPACITY)
+      todo_count = ELEMENT_CAPACITY;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Sending %u/%u crypto values to Bob\n",
+                (unsigned int) todo_count,
+                (unsigned int) s->used_element_count);
+
+    e = GNUNET_MQ_msg_extra (msg,
+                             todo_count * 2 * sizeof (struct GNUNET_CRYPTO_EccPoint),
+                             GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_ALICE_CRYPTODATA);
+    msg->contained_element_count = htonl (todo_count);
+    memcpy (&msg[1],
+            &s->payload[2 * off],
+            todo_count * 2 * sizeof (struct GNUNET_CRYPTO_EccPoint));
+    off += todo_count;
+    GNUNET_MQ_send (s->cadet_mq,
+                    e);
+  }
+  GNUNET_free (s->payload);
+  s->payload = NULL;
+}
+#undef ELEMENT_CAPACITY
+
+
+/**
+ * Encrypt a range of elements, run in a worker thread.  For each a_i
+ * we pick a random r_i and compute g_i = g^{r_i} and
+ * h_i = g^{r_i a + a_i}.  The context used for curve operations is
+ * not thread-safe, so each job creates its own.
+ *
+ * @param cls the `struct EncryptJob`
+ * @return #GNUNET_OK on success
+ */
+static int
+encrypt_job (void *cls)
+{
+  struct EncryptJob *job = cls;
+  struct AliceServiceSession *s = job->s;
+  struct GNUNET_CRYPTO_EccDlogContext *wedc;
+  gcry_mpi_t r_i;
+  gcry_mpi_t r_ia_ai;
+  gcry_mpi_point_t g_i;
+  gcry_mpi_point_t h_i;
+  uint32_t i;
+
+  wedc = GNUNET_CRYPTO_ecc_context_create ();
+  if (NULL == wedc)
+    return GNUNET_SYSERR;
+  r_ia_ai = gcry_mpi_new (0);
+  for (i = job->off; i < job->off + job->count; i++)
+  {
+    r_i = GNUNET_CRYPTO_ecc_random_mod_n (wedc);
+    g_i = GNUNET_CRYPTO_ecc_dexp_mpi (wedc,
+                                      r_i);
+    /* r_i * a is far larger than any a_i, so this stays positive */
+    gcry_mpi_mul (r_ia_ai,
+                  r_i,
+                  s->a);
+    gcry_mpi_add (r_ia_ai,
+                  r_ia_ai,
+                  s->sorted_elements[i].value);
+    h_i = GNUNET_CRYPTO_ecc_dexp_mpi (wedc,
+                                      r_ia_ai);
+    GNUNET_CRYPTO_ecc_point_to_bin (wedc,
+                                    g_i,
+                                    &s->payload[2 * i]);
+    GNUNET_CRYPTO_ecc_point_to_bin (wedc,
+                                    h_i,
+                                    &s->payload[2 * i + 1]);
+    GNUNET_CRYPTO_ecc_free (g_i);
+    GNUNET_CRYPTO_ecc_free (h_i);
+    gcry_mpi_release (r_i);
+  }
+  gcry_mpi_release (r_ia_ai);
+  GNUNET_CRYPTO_ecc_dlog_release (wedc);
+  return GNUNET_OK;
+}
+
+
+/**
+ * An encryption job finished.  Once all of them are done, send the
+ * result to Bob.
+ *
+ * @param cls the `struct EncryptJob`
+ * @param result #GNUNET_OK on success
+ */
+static void
+encrypt_job_done (void *cls,
+                  int result)
+{
+  struct EncryptJob *job = cls;
+  struct AliceServiceSession *s = job->s;
+
+  job->job = NULL;
+  s->jobs_pending--;
+  if ( (GNUNET_OK != result) &&
+       (GNUNET_SCALARPRODUCT_STATUS_ACTIVE == s->status) )
+  {
+    GNUNET_break (0);
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+  }
+  if (0 != s->jobs_pending)
+    return;
+  GNUNET_free (s->jobs);
+  s->jobs = NULL;
+  s->num_jobs = 0;
+  if (GNUNET_SCALARPRODUCT_STATUS_ACTIVE != s->status)
+    return;
+  transmit_alices_cryptodata_message (s);
+}
+
+
+/**
+ * Encrypt the intersected elements and send them from Alice to Bob.
+ * Encryption is spread over the crypto offload pool in chunks of
+ * #ELEMENTS_PER_JOB elements.
+ *
+ * @param s the associated service session
+ */
+static void
+send_alices_cryptodata_message (struct AliceServiceSession *s)
+{
+  unsigned int i;
+
+  s->sorted_elements = GSP_sort_elements (s->intersected_elements,
+                                          &s->used_element_count);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Finished intersection, %d items remain\n",
+       s->used_element_count);
+  if (0 == s->used_element_count)
+  {
+    /* empty intersection, Bob knows that as well */
+    s->product = gcry_mpi_new (0);
+    transmit_client_response (s);
+    return;
+  }
+  s->a = GNUNET_CRYPTO_ecc_random_mod_n (edc);
+  s->payload = GNUNET_malloc_large (2 * s->used_element_count *
+                                    sizeof (struct GNUNET_CRYPTO_EccPoint));
+  if (NULL == s->payload)
+  {
+    GNUNET_break (0);
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return;
+  }
+  s->num_jobs = (s->used_element_count + ELEMENTS_PER_JOB - 1) / ELEMENTS_PER_JOB;
+  s->jobs = GNUNET_new_array (s->num_jobs,
+                              struct EncryptJob);
+  s->jobs_pending = s->num_jobs;
+  for (i = 0; i < s->num_jobs; i++)
+  {
+    s->jobs[i].s = s;
+    s->jobs[i].off = i * ELEMENTS_PER_JOB;
+    s->jobs[i].count = GNUNET_MIN (ELEMENTS_PER_JOB,
+                                   s->used_element_count - s->jobs[i].off);
+  }
+  for (i = 0; i < s->num_jobs; i++)
+    s->jobs[i].job = GNUNET_CRYPTO_offload (&encrypt_job,
+                                            &s->jobs[i],
+                                            &encrypt_job_done,
+                                            &s->jobs[i]);
+}
+
+
+/**
+ * Callback for set operation results. Called for each element
+ * that should be removed from the result set, and then once
+ * to indicate that the set intersection operation is done.
+ *
+ * @param cls closure with the `struct AliceServiceSession`
+ * @param element a result element, only valid if status is #GNUNET_SET_STATUS_OK
+ * @param status what has happened with the set intersection?
+ */
+static void
+cb_intersection_element_removed (void *cls,
+                                 const struct GNUNET_SET_Element *element,
+                                 enum GNUNET_SET_Status status)
+{
+  struct AliceServiceSession *s = cls;
+
+  switch (status)
+  {
+  case GNUNET_SET_STATUS_OK:
+    /* this element has been removed from the set */
+    GSP_remove_element (s->intersected_elements,
+                        element);
+    return;
+  case GNUNET_SET_STATUS_DONE:
+    s->intersection_op = NULL;
+    if (NULL != s->intersection_set)
+    {
+      GNUNET_SET_destroy (s->intersection_set);
+      s->intersection_set = NULL;
+    }
+    send_alices_cryptodata_message (s);
+    return;
+  case GNUNET_SET_STATUS_HALF_DONE:
+    /* unexpected for intersection */
+    GNUNET_break (0);
+    return;
+  case GNUNET_SET_STATUS_FAILURE:
+    /* unhandled status code */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Set intersection failed!\n");
+    if (NULL != s->intersection_listen)
+    {
+      GNUNET_SET_listen_cancel (s->intersection_listen);
+      s->intersection_listen = NULL;
+    }
+    s->intersection_op = NULL;
+    if (NULL != s->intersection_set)
+    {
+      GNUNET_SET_destroy (s->intersection_set);
+      s->intersection_set = NULL;
+    }
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return;
+  default:
+    GNUNET_break (0);
+    return;
+  }
+}
+
+
+/**
+ * Called when another peer wants to do a set operation with the
+ * local peer. If a listen error occurs, the @a request is NULL.
+ *
+ * @param cls closure with the `struct AliceServiceSession *`
+ * @param other_peer the other peer
+ * @param context_msg message with application specific information from
+ *        the other peer
+ * @param request request from the other peer (never NULL), use GNUNET_SET_accept()
+ *        to accept it, otherwise the request will be refused
+ *        Note that we can't just return value from the listen callback,
+ *        as it is also necessary to specify the set we want to do the
+ *        operation with, whith sometimes can be derived from the context
+ *        message. It's necessary to specify the timeout.
+ */
+static void
+cb_intersection_request_alice (void *cls,
+                               const struct GNUNET_PeerIdentity *other_peer,
+                               const struct GNUNET_MessageHeader *context_msg,
+                               struct GNUNET_SET_Request *request)
+{
+  struct AliceServiceSession *s = cls;
+
+  if (0 != memcmp (other_peer,
+                   &s->peer,
+                   sizeof (struct GNUNET_PeerIdentity)))
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  s->intersection_op
+    = GNUNET_SET_accept (request,
+                         GNUNET_SET_RESULT_REMOVED,
+                         &cb_intersection_element_removed,
+                         s);
+  if (NULL == s->intersection_op)
+  {
+    GNUNET_break (0);
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_SET_commit (s->intersection_op,
+                         s->intersection_set))
+  {
+    GNUNET_break (0);
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return;
+  }
+  GNUNET_SET_destroy (s->intersection_set);
+  s->intersection_set = NULL;
+  GNUNET_SET_listen_cancel (s->intersection_listen);
+  s->intersection_listen = NULL;
+}
+
+
+/**
+ * Our client has finished sending us its multipart message.
+ *
+ * @param session the service session context
+ */
+static void
+client_request_complete_alice (struct AliceServiceSession *s)
+{
+  struct EccServiceRequestMessage *msg;
+  struct GNUNET_MQ_Envelope *e;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Creating new channel for session with key %s.\n",
+              GNUNET_h2s (&s->session_id));
+  s->channel
+    = GNUNET_CADET_channel_create (my_cadet,
+                                   s,
+                                   &s->peer,
+                                   GNUNET_APPLICATION_TYPE_SCALARPRODUCT_ECC,
+                                   GNUNET_CADET_OPTION_RELIABLE);
+  if (NULL == s->channel)
+  {
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    prepare_client_end_notification (s);
+    return;
+  }
+  s->cadet_mq = GNUNET_CADET_mq_create (s->channel);
+  s->intersection_listen
+    = GNUNET_SET_listen (cfg,
+                         GNUNET_SET_OPERATION_INTERSECTION,
+                         &s->session_id,
+                         &cb_intersection_request_alice,
+                         s);
+  if (NULL == s->intersection_listen)
+  {
+    s->status = GNUNET_SCALARPRODUCT_STATUS_FAILURE;
+    GNUNET_CADET_channel_destroy (s->channel);
+    s->channel = NULL;
+    prepare_client_end_notification (s);
+    return;
+  }
+
+  e = GNUNET_MQ_msg (msg,
+                     GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_SESSION_INITIALIZATION);
+  msg->session_id = s->session_id;
+  GNUNET_MQ_send (s->cadet_mq,
+                  e);
+}
+
+
+/**
+ * We're receiving additional set data. Add it to our
+ * set and if we are done, initiate the transaction.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+GSS_handle_alice_client_message_multipart (void *cls,
+                                           struct GNUNET_SERVER_Client *client,
+                                           const struct GNUNET_MessageHeader *message)
+{
+  struct AliceServiceSession *s;
+  uint32_t contained_count;
+  const struct GNUNET_SCALARPRODUCT_Element *elements;
+
+  s = GNUNET_SERVER_client_get_user_context (client,
+                                             struct AliceServiceSession);
+  if (NULL == s)
+  {
+    /* session needs to already exist */
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client,
+                                GNUNET_SYSERR);
+    return;
+  }
+  elements = GSP_check_client_multipart (message,
+                                         s->total,
+                                         s->client_received_element_count,
+                                         &contained_count);
+  if (NULL == elements)
+  {
+    GNUNET_SERVER_receive_done (client,
+                                GNUNET_SYSERR);
+    return;
+  }
+  s->client_received_element_count += contained_count;
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
+  GNUNET_SERVER_receive_done (client,
+                              GNUNET_OK);
+  if (s->total != s->client_received_element_count)
+  {
+    /* more to come */
+    return;
+  }
+  client_request_complete_alice (s);
+}
+
+
+/**
+ * Handler for Alice's client request message.
+ * We are doing request-initiation to compute a scalar product with a peer.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ */
+static void
+GSS_handle_alice_client_message (void *cls,
+                                 struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *message)
+{
+  const struct AliceComputationMessage *msg;
+  struct AliceServiceSession *s;
+  uint32_t contained_count;
+  uint32_t total_count;
+  const struct GNUNET_SCALARPRODUCT_Element *elements;
+  uint16_t msize;
+
+  s = GNUNET_SERVER_client_get_user_context (client,
+                                             struct AliceServiceSession);
+  if (NULL != s)
+  {
+    /* only one concurrent session per client connection allowed,
+       simplifies logic a lot... */
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  msize = ntohs (message->size);
+  if (msize < sizeof (struct AliceComputationMessage))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  msg = (const struct AliceComputationMessage *) message;
+  total_count = ntohl (msg->element_count_total);
+  contained_count = ntohl (msg->element_count_contained);
+  if ( (0 == total_count) ||
+       (0 == contained_count) ||
+       (msize != (sizeof (struct AliceComputationMessage) +
+                  contained_count * sizeof (struct GNUNET_SCALARPRODUCT_Element))) )
+  {
+    GNUNET_break_op (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+
+  s = GNUNET_new (struct AliceServiceSession);
+  s->peer = msg->peer;
+  s->status = GNUNET_SCALARPRODUCT_STATUS_ACTIVE;
+  s->client = client;
+  s->client_mq = GNUNET_MQ_queue_for_server_client (client);
+  s->total = total_count;
+  s->client_received_element_count = contained_count;
+  s->session_id = msg->session_key;
+  elements = (const struct GNUNET_SCALARPRODUCT_Element *) &msg[1];
+  s->intersected_elements = GNUNET_CONTAINER_multihashmap_create (s->total,
+                                                                  GNUNET_YES);
+  s->intersection_set = GNUNET_SET_create (cfg,
+                                           GNUNET_SET_OPERATION_INTERSECTION);
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
+  GNUNET_CONTAINER_DLL_insert (s_head,
+                               s_tail,
+                               s);
+  GNUNET_SERVER_client_set_user_context (client,
+                                         s);
+  GNUNET_SERVER_receive_done (client,
+                              GNUNET_OK);
+  if (s->total != s->client_received_element_count)
+  {
+    /* wait for multipart msg */
+    return;
+  }
+  client_request_complete_alice (s);
+}
+
+
+/**
+ * Task run during shutdown.
+ *
+ * @param cls unused
+ * @param tc unused
+ */
+static void
+shutdown_task (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Shutting down, initiating cleanup.\n");
+  /* destroy our channels before disconnecting from CADET */
+  while (NULL != s_head)
+    destroy_service_session (s_head);
+  if (NULL != my_cadet)
+  {
+    GNUNET_CADET_disconnect (my_cadet);
+    my_cadet = NULL;
+  }
+  if (NULL != edc)
+  {
+    GNUNET_CRYPTO_ecc_dlog_release (edc);
+    edc = NULL;
+  }
+}
+
+
+/**
+ * A client disconnected.
+ *
+ * Remove the associated session(s), release data structures
+ * and cancel pending outgoing transmissions to the client.
+ *
+ * @param cls closure, NULL
+ * @param client identification of the client
+ */
+static void
+handle_client_disconnect (void *cls,
+                          struct GNUNET_SERVER_Client *client)
+{
+  struct AliceServiceSession *s;
+
+  if (NULL == client)
+    return;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Client %p disconnected from us.\n",
+              client);
+  s = GNUNET_SERVER_client_get_user_context (client,
+                                             struct AliceServiceSession);
+  if (NULL == s)
+    return;
+  s->client = NULL;
+  GNUNET_SERVER_client_set_user_context (client,
+                                         NULL);
+  destroy_service_session (s);
+}
+
+
+/**
+ * Initialization of the program and message handlers
+ *
+ * @param cls closure
+ * @param server the initialized server
+ * @param c configuration to use
+ */
+static void
+run (void *cls,
+     struct GNUNET_SERVER_Handle *server,
+     const struct GNUNET_CONFIGURATION_Handle *c)
+{
+  static const struct GNUNET_CADET_MessageHandler cadet_handlers[] = {
+    { &handle_bobs_cryptodata_message,
+      GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ECC_BOB_CRYPTODATA,
+      sizeof (struct EccBobCryptodataMessage) },
+    { NULL, 0, 0}
+  };
+  static const struct GNUNET_SERVER_MessageHandler server_handlers[] = {
+    { &GSS_handle_alice_client_message, NULL,
+      GNUNET_MESSAGE_TYPE_SCALARPRODUCT_CLIENT_TO_ALICE,
+      0},
+    { &GSS_handle_alice_client_message_multipart, NULL,
+      GNUNET_MESSAGE_TYPE_SCALARPRODUCT_CLIENT_MUTLIPART_ALICE,
+      0},
+    { NULL, NULL, 0, 0}
+  };
+  char *table_fn = NULL;
+
+  cfg = c;
+  if (GNUNET_OK ==
+      GNUNET_CONFIGURATION_get_value_filename (cfg,
+                                               "scalarproduct-alice",
+                                               "DLOG_TABLE",
+                                               &table_fn))
+    edc = GNUNET_CRYPTO_ecc_dlog_load (table_fn,
+                                       MAX_RESULT,
+                                       MAX_RAM);
+  if (NULL == edc)
+  {
+    edc = GNUNET_CRYPTO_ecc_dlog_prepare (MAX_RESULT,
+                                          MAX_RAM);
+    if ( (NULL != table_fn) &&
+         (GNUNET_OK !=
+          GNUNET_CRYPTO_ecc_dlog_write (edc,
+                                        table_fn)) )
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                  _("Failed to store dlog table in `%s'\n"),
+                  table_fn);
+  }
+  GNUNET_free_non_null (table_fn);
+  GNUNET_SERVER_add_handlers (server,
+                              server_handlers);
+  GNUNET_SERVER_disconnect_notify (server,
+                                   &handle_client_disconnect,
+                                   NULL);
+  my_cadet = GNUNET_CADET_connect (cfg, NULL,
+                                   NULL /* no incoming supported */,
+                                   &cb_channel_destruction,
+                                   cadet_handlers,
+                                   NULL);
+  GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
+                                &shutdown_task,
+                                NULL);
+  if (NULL == my_cadet)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Connect to CADET failed\n"));
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+}
+
+
+/**
+ * The main function for the scalarproduct service.
+ *
+ * @param argc number of arguments from the command line
+ * @param argv command line arguments
+ * @return 0 ok, 1 on error
+ */
+int
+main (int argc,
+      char *const *argv)
+{
+  return (GNUNET_OK ==
+          GNUNET_SERVICE_run (argc, argv,
+                              "scalarproduct-alice",
+                              GNUNET_SERVICE_OPTION_NONE,
+                              &run, NULL)) ? 0 : 1;
+}
+
+/* end of gnunet-service-scalarproduct-ecc_alice.c */
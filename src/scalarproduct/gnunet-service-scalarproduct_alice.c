@@ -35,34 +35,26 @@
 #include "gnunet_set_service.h"
 #include "scalarproduct.h"
 #include "gnunet-service-scalarproduct.h"
+#include "gnunet-service-scalarproduct_common.h"
 
 #define LOG(kind,...) GNUNET_log_from (kind, "scalarproduct-alice", __VA_ARGS__)
 
 /**
- * An encrypted element key-value pair.
+ * A scalarproduct session which tracks
+ * a request form the client to our final response.
  */
-struct MpiElement
+struct AliceServiceSession
 {
+
   /**
-   * Key used to identify matching pairs of values to multiply.
-   * Points into an existing data structure, to avoid copying
-   * and doubling memory use.
+   * Kept in a DLL.
    */
-  const struct GNUNET_HashCode *key;
+  struct AliceServiceSession *next;
 
   /**
-   * Value represented (a).
+   * Kept in a DLL.
    */
-  gcry_mpi_t value;
-};
-
-
-/**
- * A scalarproduct session which tracks
- * a request form the client to our final response.
- */
-struct AliceServiceSession
-{
+  struct AliceServiceSession *prev;
 
   /**
    * (hopefully) unique transaction ID
@@ -155,8 +147,7 @@ struct AliceServiceSession
 
   /**
    * How many elements actually are used for the scalar product.
-   * Size of the arrays in @e r and @e r_prime.  Sometimes also
-   * reset to 0 and used as a counter!
+   * Size of the arrays in @e sorted_elements, @e r and @e r_prime.
    */
   uint32_t used_element_count;
 
@@ -204,6 +195,11 @@ static struct GNUNET_CRYPTO_PaillierPublicKey my_pubkey;
  */
 static struct GNUNET_CRYPTO_PaillierPrivateKey my_privkey;
 
+/**
+ * Precomputed values for encryptions with #my_pubkey.
+ */
+static struct GNUNET_CRYPTO_PaillierRandomPool *my_pool;
+
 /**
  * Service's offset for values that could possibly be negative but are plaintext for encryption.
  */
@@ -214,25 +210,15 @@ static gcry_mpi_t my_offset;
  */
 static struct GNUNET_CADET_Handle *my_cadet;
 
-
 /**
- * Iterator called to free elements.
- *
- * @param cls the `struct AliceServiceSession *` (unused)
- * @param key the key (unused)
- * @param value value to free
- * @return #GNUNET_OK (continue to iterate)
+ * Head of DLL of all our sessions.
  */
-static int
-free_element_cb (void *cls,
-                 const struct GNUNET_HashCode *key,
-                 void *value)
-{
-  struct GNUNET_SCALARPRODUCT_Element *e = value;
+static struct AliceServiceSession *s_head;
 
-  GNUNET_free (e);
-  return GNUNET_OK;
-}
+/**
+ * Tail of DLL of all our sessions.
+ */
+static struct AliceServiceSession *s_tail;
 
 
 /**
@@ -243,11 +229,12 @@ free_element_cb (void *cls,
 static void
 destroy_service_session (struct AliceServiceSession *s)
 {
-  unsigned int i;
-
   if (GNUNET_YES == s->in_destroy)
     return;
   s->in_destroy = GNUNET_YES;
+  GNUNET_CONTAINER_DLL_remove (s_head,
+                               s_tail,
+                               s);
   if (NULL != s->client_mq)
   {
     GNUNET_MQ_destroy (s->client_mq);
@@ -272,10 +259,7 @@ destroy_service_session (struct AliceServiceSession *s)
   }
   if (NULL != s->intersected_elements)
   {
-    GNUNET_CONTAINER_multihashmap_iterate (s->intersected_elements,
-                                           &free_element_cb,
-                                           s);
-    GNUNET_CONTAINER_multihashmap_destroy (s->intersected_elements);
+    GSP_free_elements (s->intersected_elements);
     s->intersected_elements = NULL;
   }
   if (NULL != s->intersection_listen)
@@ -293,13 +277,9 @@ destroy_service_session (struct AliceServiceSession *s)
     GNUNET_SET_destroy (s->intersection_set);
     s->intersection_set = NULL;
   }
-  if (NULL != s->sorted_elements)
-  {
-    for (i=0;i<s->used_element_count;i++)
-      gcry_mpi_release (s->sorted_elements[i].value);
-    GNUNET_free (s->sorted_elements);
-    s->sorted_elements = NULL;
-  }
+  GSP_free_sorted_elements (s->sorted_elements,
+                            s->used_element_count);
+  s->sorted_elements = NULL;
   if (NULL != s->r)
   {
     GNUNET_free (s->r);
@@ -328,19 +308,9 @@ destroy_service_session (struct AliceServiceSession *s)
 static void
 prepare_client_end_notification (struct AliceServiceSession *session)
 {
-  struct ClientResponseMessage *msg;
-  struct GNUNET_MQ_Envelope *e;
-
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Sending session-end notification with status %d to client for session %s\n",
-              session->status,
-              GNUNET_h2s (&session->session_id));
-  e = GNUNET_MQ_msg (msg,
-                     GNUNET_MESSAGE_TYPE_SCALARPRODUCT_RESULT);
-  msg->product_length = htonl (0);
-  msg->status = htonl (session->status);
-  GNUNET_MQ_send (session->client_mq,
-                  e);
+  GSP_send_client_end (session->client_mq,
+                       &session->session_id,
+                       session->status);
 }
 
 
@@ -353,74 +323,14 @@ prepare_client_end_notification (struct AliceServiceSession *session)
 static void
 transmit_client_response (struct AliceServiceSession *s)
 {
-  struct ClientResponseMessage *msg;
-  struct GNUNET_MQ_Envelope *e;
-  unsigned char *product_exported = NULL;
-  size_t product_length = 0;
-  int32_t range;
-  gcry_error_t rc;
-  int sign;
-  gcry_mpi_t value;
-
-  if (NULL == s->product)
-  {
-    GNUNET_break (0);
-    prepare_client_end_notification (s);
-    return;
-  }
-  value = gcry_mpi_new (0);
-  sign = gcry_mpi_cmp_ui (s->product, 0);
-  if (0 > sign)
-  {
-    range = -1;
-    gcry_mpi_sub (value,
-                  value,
-                  s->product);
-  }
-  else if (0 < sign)
-  {
-    range = 1;
-    gcry_mpi_add (value, value, s->product);
-  }
-  else
-  {
-    /* result is exactly zero */
-    range = 0;
-  }
-  gcry_mpi_release (s->product);
-  s->product = NULL;
-
-  if ( (0 != range) &&
-       (0 != (rc = gcry_mpi_aprint (GCRYMPI_FMT_STD,
-                                    &product_exported,
-                                    &product_length,
-                                    value))))
-  {
-    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR,
-              "gcry_mpi_scan",
-              rc);
-    prepare_client_end_notification (s);
-    return;
-  }
-  gcry_mpi_release (value);
-  e = GNUNET_MQ_msg_extra (msg,
-                           product_length,
-                           GNUNET_MESSAGE_TYPE_SCALARPRODUCT_RESULT);
-  msg->status = htonl (GNUNET_SCALARPRODUCT_STATUS_SUCCESS);
-  msg->range = htonl (range);
-  msg->product_length = htonl (product_length);
-  if (NULL != product_exported)
+  GSP_send_client_result (s->client_mq,
+                          &s->session_id,
+                          s->product);
+  if (NULL != s->product)
   {
-    memcpy (&msg[1],
-            product_exported,
-            product_length);
-    GNUNET_free (product_exported);
+    gcry_mpi_release (s->product);
+    s->product = NULL;
   }
-  GNUNET_MQ_send (s->client_mq,
-                  e);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Sent result to client, session %s has ended!\n",
-              GNUNET_h2s (&s->session_id));
 }
 
 
@@ -489,33 +399,6 @@ compute_square_sum_mpi_elements (const struct MpiElement *vector,
 }
 
 
-/**
- * Computes the square sum over a vector of a given length.
- *
- * @param vector the vector to compute over
- * @param length the length of the vector
- * @return an MPI value containing the calculated sum, never NULL
- */
-static gcry_mpi_t
-compute_square_sum (const gcry_mpi_t *vector,
-                    uint32_t length)
-{
-  gcry_mpi_t elem;
-  gcry_mpi_t sum;
-  uint32_t i;
-
-  GNUNET_assert (NULL != (sum = gcry_mpi_new (0)));
-  GNUNET_assert (NULL != (elem = gcry_mpi_new (0)));
-  for (i = 0; i < length; i++)
-  {
-    gcry_mpi_mul (elem, vector[i], vector[i]);
-    gcry_mpi_add (sum, sum, elem);
-  }
-  gcry_mpi_release (elem);
-  return sum;
-}
-
-
 /**
  * Compute our scalar product, done by Alice
  *
@@ -545,21 +428,26 @@ compute_scalar_product (struct AliceServiceSession *session)
   for (i = 0; i < count; i++)
   {
     r[i] = gcry_mpi_new (0);
-    GNUNET_CRYPTO_paillier_decrypt (&my_privkey,
-                                    &my_pubkey,
-                                    &session->r[i],
-                                    r[i]);
+    r_prime[i] = gcry_mpi_new (0);
+  }
+  GNUNET_CRYPTO_paillier_decrypt_batch (&my_privkey,
+                                        &my_pubkey,
+                                        session->r,
+                                        count,
+                                        r);
+  GNUNET_CRYPTO_paillier_decrypt_batch (&my_privkey,
+                                        &my_pubkey,
+                                        session->r_prime,
+                                        count,
+                                        r_prime);
+  for (i = 0; i < count; i++)
+  {
     gcry_mpi_sub (r[i],
                   r[i],
                   my_offset);
     gcry_mpi_sub (r[i],
                   r[i],
                   my_offset);
-    r_prime[i] = gcry_mpi_new (0);
-    GNUNET_CRYPTO_paillier_decrypt (&my_privkey,
-                                    &my_pubkey,
-                                    &session->r_prime[i],
-                                    r_prime[i]);
     gcry_mpi_sub (r_prime[i],
                   r_prime[i],
                   my_offset);
@@ -573,13 +461,13 @@ compute_scalar_product (struct AliceServiceSession *session)
                                        count);
   // calculate U
   u = gcry_mpi_new (0);
-  tmp = compute_square_sum (r, count);
+  tmp = GSP_compute_square_sum (r, count);
   gcry_mpi_sub (u, u, tmp);
   gcry_mpi_release (tmp);
 
   //calculate U'
   u_prime = gcry_mpi_new (0);
-  tmp = compute_square_sum (r_prime, count);
+  tmp = GSP_compute_square_sum (r_prime, count);
   gcry_mpi_sub (u_prime, u_prime, tmp);
 
   GNUNET_assert (p = gcry_mpi_new (0));
@@ -620,11 +508,11 @@ compute_scalar_product (struct AliceServiceSession *session)
   gcry_mpi_release (tmp);
   for (i = 0; i < count; i++)
   {
-    gcry_mpi_release (session->sorted_elements[i].value);
     gcry_mpi_release (r[i]);
     gcry_mpi_release (r_prime[i]);
   }
-  GNUNET_free (session->sorted_elements);
+  GSP_free_sorted_elements (session->sorted_elements,
+                            count);
   session->sorted_elements = NULL;
   GNUNET_free (session->r);
   session->r = NULL;
@@ -807,56 +695,6 @@ handle_bobs_cryptodata_message (void *cls,
 }
 
 
-/**
- * Iterator to copy over messages from the hash map
- * into an array for sorting.
- *
- * @param cls the `struct AliceServiceSession *`
- * @param key the key (unused)
- * @param value the `struct GNUNET_SCALARPRODUCT_Element *`
- */
-static int
-copy_element_cb (void *cls,
-                 const struct GNUNET_HashCode *key,
-                 void *value)
-{
-  struct AliceServiceSession *s = cls;
-  struct GNUNET_SCALARPRODUCT_Element *e = value;
-  gcry_mpi_t mval;
-  int64_t val;
-
-  mval = gcry_mpi_new (0);
-  val = (int64_t) GNUNET_ntohll (e->value);
-  if (0 > val)
-    gcry_mpi_sub_ui (mval, mval, -val);
-  else
-    gcry_mpi_add_ui (mval, mval, val);
-  s->sorted_elements [s->used_element_count].value = mval;
-  s->sorted_elements [s->used_element_count].key = &e->key;
-  s->used_element_count++;
-  return GNUNET_OK;
-}
-
-
-/**
- * Compare two `struct MpiValue`s by key for sorting.
- *
- * @param a pointer to first `struct MpiValue *`
- * @param b pointer to first `struct MpiValue *`
- * @return -1 for a < b, 0 for a=b, 1 for a > b.
- */
-static int
-element_cmp (const void *a,
-             const void *b)
-{
-  const struct MpiElement *ma = a;
-  const struct MpiElement *mb = b;
-
-  return GNUNET_CRYPTO_hash_cmp (ma->key,
-                                 mb->key);
-}
-
-
 /**
  * Maximum number of elements we can put into a single cryptodata
  * message
@@ -878,23 +716,14 @@ send_alices_cryptodata_message (struct AliceServiceSession *s)
   struct GNUNET_CRYPTO_PaillierCiphertext *payload;
   unsigned int i;
   uint32_t todo_count;
-  gcry_mpi_t a;
+  gcry_mpi_t a[ELEMENT_CAPACITY];
   uint32_t off;
 
-  s->sorted_elements
-    = GNUNET_malloc (GNUNET_CONTAINER_multihashmap_size (s->intersected_elements) *
-                     sizeof (struct MpiElement));
-  s->used_element_count = 0;
-  GNUNET_CONTAINER_multihashmap_iterate (s->intersected_elements,
-                                         &copy_element_cb,
-                                         s);
+  s->sorted_elements = GSP_sort_elements (s->intersected_elements,
+                                          &s->used_element_count);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Finished intersection, %d items remain\n",
        s->used_element_count);
-  qsort (s->sorted_elements,
-         s->used_element_count,
-         sizeof (struct MpiElement),
-         &element_cmp);
   off = 0;
   while (off < s->used_element_count)
   {
@@ -911,19 +740,22 @@ send_alices_cryptodata_message (struct AliceServiceSession *s)
                              GNUNET_MESSAGE_TYPE_SCALARPRODUCT_ALICE_CRYPTODATA);
     msg->contained_element_count = htonl (todo_count);
     payload = (struct GNUNET_CRYPTO_PaillierCiphertext *) &msg[1];
-    a = gcry_mpi_new (0);
-    for (i = off; i < off + todo_count; i++)
+    for (i = 0; i < todo_count; i++)
     {
-      gcry_mpi_add (a,
-                    s->sorted_elements[i].value,
+      a[i] = gcry_mpi_new (0);
+      gcry_mpi_add (a[i],
+                    s->sorted_elements[off + i].value,
                     my_offset);
-      GNUNET_assert (3 ==
-                     GNUNET_CRYPTO_paillier_encrypt (&my_pubkey,
-                                                     a,
-                                                     3,
-                                                     &payload[i - off]));
     }
-    gcry_mpi_release (a);
+    GNUNET_assert (3 ==
+                   GNUNET_CRYPTO_paillier_encrypt_batch (&my_pubkey,
+                                                         my_pool,
+                                                         a,
+                                                         todo_count,
+                                                         3,
+                                                         payload));
+    for (i = 0; i < todo_count; i++)
+      gcry_mpi_release (a[i]);
     off += todo_count;
     GNUNET_MQ_send (s->cadet_mq,
                     e);
@@ -946,24 +778,13 @@ cb_intersection_element_removed (void *cls,
                                  enum GNUNET_SET_Status status)
 {
   struct AliceServiceSession *s = cls;
-  struct GNUNET_SCALARPRODUCT_Element *se;
 
   switch (status)
   {
   case GNUNET_SET_STATUS_OK:
     /* this element has been removed from the set */
-    se = GNUNET_CONTAINER_multihashmap_get (s->intersected_elements,
-                                            element->data);
-    GNUNET_assert (NULL != se);
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Intersection removed element with key %s and value %lld\n",
-         GNUNET_h2s (&se->key),
-         (long long) GNUNET_ntohll (se->value));
-    GNUNET_assert (GNUNET_YES ==
-                   GNUNET_CONTAINER_multihashmap_remove (s->intersected_elements,
-                                                         element->data,
-                                                         se));
-    GNUNET_free (se);
+    GSP_remove_element (s->intersected_elements,
+                        element);
     return;
   case GNUNET_SET_STATUS_DONE:
     s->intersection_op = NULL;
@@ -1125,14 +946,9 @@ GSS_handle_alice_client_message_multipart (void *cls,
                                            struct GNUNET_SERVER_Client *client,
                                            const struct GNUNET_MessageHeader *message)
 {
-  const struct ComputationBobCryptodataMultipartMessage * msg;
   struct AliceServiceSession *s;
   uint32_t contained_count;
   const struct GNUNET_SCALARPRODUCT_Element *elements;
-  uint32_t i;
-  uint16_t msize;
-  struct GNUNET_SET_Element set_elem;
-  struct GNUNET_SCALARPRODUCT_Element *elem;
 
   s = GNUNET_SERVER_client_get_user_context (client,
                                              struct AliceServiceSession);
@@ -1144,54 +960,21 @@ GSS_handle_alice_client_message_multipart (void *cls,
                                 GNUNET_SYSERR);
     return;
   }
-  msize = ntohs (message->size);
-  if (msize < sizeof (struct ComputationBobCryptodataMultipartMessage))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client,
-                                GNUNET_SYSERR);
-    return;
-  }
-  msg = (const struct ComputationBobCryptodataMultipartMessage *) message;
-  contained_count = ntohl (msg->element_count_contained);
-
-  if ( (msize != (sizeof (struct ComputationBobCryptodataMultipartMessage) +
-                  contained_count * sizeof (struct GNUNET_SCALARPRODUCT_Element))) ||
-       (0 == contained_count) ||
-       (s->total == s->client_received_element_count) ||
-       (s->total < s->client_received_element_count + contained_count) )
+  elements = GSP_check_client_multipart (message,
+                                         s->total,
+                                         s->client_received_element_count,
+                                         &contained_count);
+  if (NULL == elements)
   {
-    GNUNET_break_op (0);
     GNUNET_SERVER_receive_done (client,
                                 GNUNET_SYSERR);
     return;
   }
   s->client_received_element_count += contained_count;
-  elements = (const struct GNUNET_SCALARPRODUCT_Element *) &msg[1];
-  for (i = 0; i < contained_count; i++)
-  {
-    elem = GNUNET_new (struct GNUNET_SCALARPRODUCT_Element);
-    memcpy (elem,
-            &elements[i],
-            sizeof (struct GNUNET_SCALARPRODUCT_Element));
-    if (GNUNET_SYSERR ==
-        GNUNET_CONTAINER_multihashmap_put (s->intersected_elements,
-                                           &elem->key,
-                                           elem,
-                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-    {
-      GNUNET_break (0);
-      GNUNET_free (elem);
-      continue;
-    }
-    set_elem.data = &elem->key;
-    set_elem.size = sizeof (elem->key);
-    set_elem.element_type = 0;
-    GNUNET_SET_add_element (s->intersection_set,
-                            &set_elem,
-                            NULL, NULL);
-    s->used_element_count++;
-  }
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
   GNUNET_SERVER_receive_done (client,
                               GNUNET_OK);
   if (s->total != s->client_received_element_count)
@@ -1221,10 +1004,7 @@ GSS_handle_alice_client_message (void *cls,
   uint32_t contained_count;
   uint32_t total_count;
   const struct GNUNET_SCALARPRODUCT_Element *elements;
-  uint32_t i;
   uint16_t msize;
-  struct GNUNET_SET_Element set_elem;
-  struct GNUNET_SCALARPRODUCT_Element *elem;
 
   s = GNUNET_SERVER_client_get_user_context (client,
                                              struct AliceServiceSession);
@@ -1269,33 +1049,13 @@ GSS_handle_alice_client_message (void *cls,
                                                                   GNUNET_YES);
   s->intersection_set = GNUNET_SET_create (cfg,
                                            GNUNET_SET_OPERATION_INTERSECTION);
-  for (i = 0; i < contained_count; i++)
-  {
-    if (0 == GNUNET_ntohll (elements[i].value))
-      continue;
-    elem = GNUNET_new (struct GNUNET_SCALARPRODUCT_Element);
-    memcpy (elem,
-            &elements[i],
-            sizeof (struct GNUNET_SCALARPRODUCT_Element));
-    if (GNUNET_SYSERR ==
-        GNUNET_CONTAINER_multihashmap_put (s->intersected_elements,
-                                           &elem->key,
-                                           elem,
-                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-    {
-      /* element with same key encountered twice! */
-      GNUNET_break (0);
-      GNUNET_free (elem);
-      continue;
-    }
-    set_elem.data = &elem->key;
-    set_elem.size = sizeof (elem->key);
-    set_elem.element_type = 0;
-    GNUNET_SET_add_element (s->intersection_set,
-                            &set_elem,
-                            NULL, NULL);
-    s->used_element_count++;
-  }
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
+  GNUNET_CONTAINER_DLL_insert (s_head,
+                               s_tail,
+                               s);
   GNUNET_SERVER_client_set_user_context (client,
                                          s);
   GNUNET_SERVER_receive_done (client,
@@ -1321,12 +1081,19 @@ shutdown_task (void *cls,
 {
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Shutting down, initiating cleanup.\n");
-  // FIXME: we have to cut our connections to CADET first!
+  /* destroy our channels before disconnecting from CADET */
+  while (NULL != s_head)
+    destroy_service_session (s_head);
   if (NULL != my_cadet)
   {
     GNUNET_CADET_disconnect (my_cadet);
     my_cadet = NULL;
   }
+  if (NULL != my_pool)
+  {
+    GNUNET_CRYPTO_paillier_pool_destroy (my_pool);
+    my_pool = NULL;
+  }
 }
 
 
@@ -1403,6 +1170,8 @@ run (void *cls,
 
   GNUNET_CRYPTO_paillier_create (&my_pubkey,
                                  &my_privkey);
+  my_pool = GNUNET_CRYPTO_paillier_pool_create (&my_pubkey,
+                                                ELEMENT_CAPACITY);
   GNUNET_SERVER_add_handlers (server,
                               server_handlers);
   GNUNET_SERVER_disconnect_notify (server,
@@ -35,29 +35,11 @@
 #include "gnunet_set_service.h"
 #include "scalarproduct.h"
 #include "gnunet-service-scalarproduct.h"
+#include "gnunet-service-scalarproduct_common.h"
 
 #define LOG(kind,...) GNUNET_log_from (kind, "scalarproduct-bob", __VA_ARGS__)
 
 
-/**
- * An encrypted element key-value pair.
- */
-struct MpiElement
-{
-  /**
-   * Key used to identify matching pairs of values to multiply.
-   * Points into an existing data structure, to avoid copying
-   * and doubling memory use.
-   */
-  const struct GNUNET_HashCode *key;
-
-  /**
-   * Value represented (a).
-   */
-  gcry_mpi_t value;
-};
-
-
 /**
  * An incoming session from CADET.
  */
@@ -157,8 +139,7 @@ struct BobServiceSession
 
   /**
    * How many elements actually are used for the scalar product.
-   * Size of the arrays in @e r and @e r_prime.  Also sometimes
-   * used as an index into the arrays during construction.
+   * Size of the arrays in @e sorted_elements, @e r and @e r_prime.
    */
   uint32_t used_element_count;
 
@@ -307,25 +288,6 @@ find_matching_cadet_session (const struct GNUNET_HashCode *key)
 }
 
 
-/**
- * Callback used to free the elements in the map.
- *
- * @param cls NULL
- * @param key key of the element
- * @param value the value to free
- */
-static int
-free_element_cb (void *cls,
-                 const struct GNUNET_HashCode *key,
-                 void *value)
-{
-  struct GNUNET_SCALARPRODUCT_Element *element = value;
-
-  GNUNET_free (element);
-  return GNUNET_OK;
-}
-
-
 /**
  * Destroy session state, we are done with it.
  *
@@ -344,7 +306,6 @@ static void
 destroy_service_session (struct BobServiceSession *s)
 {
   struct CadetIncomingSession *in;
-  unsigned int i;
 
   if (GNUNET_YES == s->in_destroy)
     return;
@@ -361,6 +322,8 @@ destroy_service_session (struct BobServiceSession *s)
   }
   if (NULL != s->client)
   {
+    GNUNET_SERVER_client_set_user_context (s->client,
+                                           NULL);
     GNUNET_SERVER_client_disconnect (s->client);
     s->client = NULL;
   }
@@ -370,10 +333,7 @@ destroy_service_session (struct BobServiceSession *s)
                                                        s));
   if (NULL != s->intersected_elements)
   {
-    GNUNET_CONTAINER_multihashmap_iterate (s->intersected_elements,
-                                           &free_element_cb,
-                                           NULL);
-    GNUNET_CONTAINER_multihashmap_destroy (s->intersected_elements);
+    GSP_free_elements (s->intersected_elements);
     s->intersected_elements = NULL;
   }
   if (NULL != s->intersection_op)
@@ -391,13 +351,9 @@ destroy_service_session (struct BobServiceSession *s)
     GNUNET_free (s->e_a);
     s->e_a = NULL;
   }
-  if (NULL != s->sorted_elements)
-  {
-    for (i=0;i<s->used_element_count;i++)
-      gcry_mpi_release (s->sorted_elements[i].value);
-    GNUNET_free (s->sorted_elements);
-    s->sorted_elements = NULL;
-  }
+  GSP_free_sorted_elements (s->sorted_elements,
+                            s->used_element_count);
+  s->sorted_elements = NULL;
   if (NULL != s->r)
   {
     GNUNET_free (s->r);
@@ -467,20 +423,9 @@ destroy_cadet_session (struct CadetIncomingSession *in)
 static void
 prepare_client_end_notification (struct BobServiceSession *session)
 {
-  struct ClientResponseMessage *msg;
-  struct GNUNET_MQ_Envelope *e;
-
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Sending session-end notification with status %d to client for session %s\n",
-              session->status,
-              GNUNET_h2s (&session->session_id));
-  e = GNUNET_MQ_msg (msg,
-                     GNUNET_MESSAGE_TYPE_SCALARPRODUCT_RESULT);
-  msg->range = 0;
-  msg->product_length = htonl (0);
-  msg->status = htonl (session->status);
-  GNUNET_MQ_send (session->client_mq,
-                  e);
+  GSP_send_client_end (session->client_mq,
+                       &session->session_id,
+                       session->status);
 }
 
 
@@ -665,34 +610,6 @@ transmit_bobs_cryptodata_message (struct BobServiceSession *s)
 #undef ELEMENT_CAPACITY
 
 
-/**
- * Computes the square sum over a vector of a given length.
- *
- * @param vector the vector to compute over
- * @param length the length of the vector
- * @return an MPI value containing the calculated sum, never NULL
- * TODO: code duplication with Alice!
- */
-static gcry_mpi_t
-compute_square_sum (const gcry_mpi_t *vector,
-                    uint32_t length)
-{
-  gcry_mpi_t elem;
-  gcry_mpi_t sum;
-  uint32_t i;
-
-  GNUNET_assert (NULL != (sum = gcry_mpi_new (0)));
-  GNUNET_assert (NULL != (elem = gcry_mpi_new (0)));
-  for (i = 0; i < length; i++)
-  {
-    gcry_mpi_mul (elem, vector[i], vector[i]);
-    gcry_mpi_add (sum, sum, elem);
-  }
-  gcry_mpi_release (elem);
-  return sum;
-}
-
-
 /**
  * Compute the values
  *  (1)[]: $E_A(a_{pi(i)}) otimes E_A(- r_{pi(i)} - b_{pi(i)}) &= E_A(a_{pi(i)} - r_{pi(i)} - b_{pi(i)})$
@@ -799,7 +716,7 @@ compute_service_response (struct BobServiceSession *session)
   gcry_mpi_release (tmp);
 
   // Calculate S' =  E(SUM( r_i^2 ))
-  tmp = compute_square_sum (rand, count);
+  tmp = GSP_compute_square_sum (rand, count);
   GNUNET_assert (1 ==
                  GNUNET_CRYPTO_paillier_encrypt (&session->cadet->remote_pubkey,
                                                  tmp,
@@ -810,7 +727,7 @@ compute_service_response (struct BobServiceSession *session)
   // Calculate S = E(SUM( (r_i + b_i)^2 ))
   for (i = 0; i < count; i++)
     gcry_mpi_add (rand[i], rand[i], b[i].value);
-  tmp = compute_square_sum (rand, count);
+  tmp = GSP_compute_square_sum (rand, count);
   GNUNET_assert (1 ==
                  GNUNET_CRYPTO_paillier_encrypt (&session->cadet->remote_pubkey,
                                                  tmp,
@@ -843,58 +760,6 @@ compute_service_response (struct BobServiceSession *session)
 }
 
 
-/**
- * Iterator to copy over messages from the hash map
- * into an array for sorting.
- *
- * @param cls the `struct BobServiceSession *`
- * @param key the key (unused)
- * @param value the `struct GNUNET_SCALARPRODUCT_Element *`
- * TODO: code duplication with Alice!
- */
-static int
-copy_element_cb (void *cls,
-                 const struct GNUNET_HashCode *key,
-                 void *value)
-{
-  struct BobServiceSession *s = cls;
-  struct GNUNET_SCALARPRODUCT_Element *e = value;
-  gcry_mpi_t mval;
-  int64_t val;
-
-  mval = gcry_mpi_new (0);
-  val = (int64_t) GNUNET_ntohll (e->value);
-  if (0 > val)
-    gcry_mpi_sub_ui (mval, mval, -val);
-  else
-    gcry_mpi_add_ui (mval, mval, val);
-  s->sorted_elements [s->used_element_count].value = mval;
-  s->sorted_elements [s->used_element_count].key = &e->key;
-  s->used_element_count++;
-  return GNUNET_OK;
-}
-
-
-/**
- * Compare two `struct MpiValue`s by key for sorting.
- *
- * @param a pointer to first `struct MpiValue *`
- * @param b pointer to first `struct MpiValue *`
- * @return -1 for a < b, 0 for a=b, 1 for a > b.
- * TODO: code duplication with Alice!
- */
-static int
-element_cmp (const void *a,
-             const void *b)
-{
-  const struct MpiElement *ma = a;
-  const struct MpiElement *mb = b;
-
-  return GNUNET_CRYPTO_hash_cmp (ma->key,
-                                 mb->key);
-}
-
-
 /**
  * Intersection operation and receiving data via CADET from
  * Alice are both done, compute and transmit our reply via
@@ -907,20 +772,10 @@ transmit_cryptographic_reply (struct BobServiceSession *s)
 {
   struct GNUNET_CADET_Channel *channel;
 
-  /* TODO: code duplication with Alice! */
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Received everything, building reply for Alice\n");
-  s->sorted_elements
-    = GNUNET_malloc (GNUNET_CONTAINER_multihashmap_size (s->intersected_elements) *
-                     sizeof (struct MpiElement));
-  s->used_element_count = 0;
-  GNUNET_CONTAINER_multihashmap_iterate (s->intersected_elements,
-                                         &copy_element_cb,
-                                         s);
-  qsort (s->sorted_elements,
-         s->used_element_count,
-         sizeof (struct MpiElement),
-         &element_cmp);
+  s->sorted_elements = GSP_sort_elements (s->intersected_elements,
+                                          &s->used_element_count);
   if (GNUNET_OK !=
       compute_service_response (s))
   {
@@ -1031,24 +886,13 @@ cb_intersection_element_removed (void *cls,
                                  enum GNUNET_SET_Status status)
 {
   struct BobServiceSession *s = cls;
-  struct GNUNET_SCALARPRODUCT_Element *se;
 
   switch (status)
   {
   case GNUNET_SET_STATUS_OK:
     /* this element has been removed from the set */
-    se = GNUNET_CONTAINER_multihashmap_get (s->intersected_elements,
-                                            element->data);
-    GNUNET_assert (NULL != se);
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "Removed element with key %s and value %lld\n",
-         GNUNET_h2s (&se->key),
-         (long long) GNUNET_ntohll (se->value));
-    GNUNET_assert (GNUNET_YES ==
-                   GNUNET_CONTAINER_multihashmap_remove (s->intersected_elements,
-                                                         element->data,
-                                                         se));
-    GNUNET_free (se);
+    GSP_remove_element (s->intersected_elements,
+                        element);
     return;
   case GNUNET_SET_STATUS_DONE:
     s->intersection_op = NULL;
@@ -1229,14 +1073,9 @@ GSS_handle_bob_client_message_multipart (void *cls,
                                          struct GNUNET_SERVER_Client *client,
                                          const struct GNUNET_MessageHeader *message)
 {
-  const struct ComputationBobCryptodataMultipartMessage * msg;
   struct BobServiceSession *s;
   uint32_t contained_count;
   const struct GNUNET_SCALARPRODUCT_Element *elements;
-  uint32_t i;
-  uint16_t msize;
-  struct GNUNET_SET_Element set_elem;
-  struct GNUNET_SCALARPRODUCT_Element *elem;
 
   s = GNUNET_SERVER_client_get_user_context (client,
                                              struct BobServiceSession);
@@ -1248,53 +1087,20 @@ GSS_handle_bob_client_message_multipart (void *cls,
                                 GNUNET_SYSERR);
     return;
   }
-  msize = ntohs (message->size);
-  if (msize < sizeof (struct ComputationBobCryptodataMultipartMessage))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client,
-                                GNUNET_SYSERR);
-    return;
-  }
-  msg = (const struct ComputationBobCryptodataMultipartMessage *) message;
-  contained_count = ntohl (msg->element_count_contained);
-
-  if ( (msize != (sizeof (struct ComputationBobCryptodataMultipartMessage) +
-                  contained_count * sizeof (struct GNUNET_SCALARPRODUCT_Element))) ||
-       (0 == contained_count) ||
-       (UINT16_MAX < contained_count) ||
-       (s->total == s->client_received_element_count) ||
-       (s->total < s->client_received_element_count + contained_count) )
+  elements = GSP_check_client_multipart (message,
+                                         s->total,
+                                         s->client_received_element_count,
+                                         &contained_count);
+  if (NULL == elements)
   {
-    GNUNET_break_op (0);
     GNUNET_SERVER_receive_done (client,
                                 GNUNET_SYSERR);
     return;
   }
-  elements = (const struct GNUNET_SCALARPRODUCT_Element *) &msg[1];
-  for (i = 0; i < contained_count; i++)
-  {
-    elem = GNUNET_new (struct GNUNET_SCALARPRODUCT_Element);
-    memcpy (elem,
-            &elements[i],
-            sizeof (struct GNUNET_SCALARPRODUCT_Element));
-    if (GNUNET_SYSERR ==
-        GNUNET_CONTAINER_multihashmap_put (s->intersected_elements,
-                                           &elem->key,
-                                           elem,
-                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-    {
-      GNUNET_break (0);
-      GNUNET_free (elem);
-      continue;
-    }
-    set_elem.data = &elem->key;
-    set_elem.size = sizeof (elem->key);
-    set_elem.element_type = 0;
-    GNUNET_SET_add_element (s->intersection_set,
-                            &set_elem,
-                            NULL, NULL);
-  }
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
   s->client_received_element_count += contained_count;
   GNUNET_SERVER_receive_done (client,
                               GNUNET_OK);
@@ -1332,9 +1138,6 @@ GSS_handle_bob_client_message (void *cls,
   uint32_t contained_count;
   uint32_t total_count;
   const struct GNUNET_SCALARPRODUCT_Element *elements;
-  uint32_t i;
-  struct GNUNET_SET_Element set_elem;
-  struct GNUNET_SCALARPRODUCT_Element *elem;
   uint16_t msize;
 
   s = GNUNET_SERVER_client_get_user_context (client,
@@ -1395,32 +1198,10 @@ GSS_handle_bob_client_message (void *cls,
                                                                   GNUNET_YES);
   s->intersection_set = GNUNET_SET_create (cfg,
                                            GNUNET_SET_OPERATION_INTERSECTION);
-  for (i = 0; i < contained_count; i++)
-  {
-    if (0 == GNUNET_ntohll (elements[i].value))
-      continue;
-    elem = GNUNET_new (struct GNUNET_SCALARPRODUCT_Element);
-    memcpy (elem,
-            &elements[i],
-            sizeof (struct GNUNET_SCALARPRODUCT_Element));
-    if (GNUNET_SYSERR ==
-        GNUNET_CONTAINER_multihashmap_put (s->intersected_elements,
-                                           &elem->key,
-                                           elem,
-                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
-    {
-      GNUNET_break (0);
-      GNUNET_free (elem);
-      continue;
-    }
-    set_elem.data = &elem->key;
-    set_elem.size = sizeof (elem->key);
-    set_elem.element_type = 0;
-    GNUNET_SET_add_element (s->intersection_set,
-                            &set_elem,
-                            NULL, NULL);
-    s->used_element_count++;
-  }
+  GSP_add_elements (s->intersected_elements,
+                    s->intersection_set,
+                    elements,
+                    contained_count);
   GNUNET_SERVER_client_set_user_context (client,
                                          s);
   GNUNET_SERVER_receive_done (client,
@@ -1444,6 +1225,46 @@ GSS_handle_bob_client_message (void *cls,
 }
 
 
+/**
+ * Iterator called on shutdown to destroy all client sessions.
+ *
+ * @param cls NULL
+ * @param key the session key (unused)
+ * @param value the `struct BobServiceSession *` to destroy
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+destroy_client_session_cb (void *cls,
+                           const struct GNUNET_HashCode *key,
+                           void *value)
+{
+  struct BobServiceSession *s = value;
+
+  destroy_service_session (s);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Iterator called on shutdown to destroy all CADET sessions.
+ *
+ * @param cls NULL
+ * @param key the session key (unused)
+ * @param value the `struct CadetIncomingSession *` to destroy
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+destroy_cadet_session_cb (void *cls,
+                          const struct GNUNET_HashCode *key,
+                          void *value)
+{
+  struct CadetIncomingSession *in = value;
+
+  destroy_cadet_session (in);
+  return GNUNET_OK;
+}
+
+
 /**
  * Task run during shutdown.
  *
@@ -1456,7 +1277,13 @@ shutdown_task (void *cls,
 {
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Shutting down, initiating cleanup.\n");
-  // FIXME: we have to cut our connections to CADET first!
+  /* destroy our channels before disconnecting from CADET */
+  GNUNET_CONTAINER_multihashmap_iterate (client_sessions,
+                                         &destroy_client_session_cb,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_iterate (cadet_sessions,
+                                         &destroy_cadet_session_cb,
+                                         NULL);
   if (NULL != my_cadet)
   {
     GNUNET_CADET_disconnect (my_cadet);
@@ -0,0 +1,457 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2013, 2014, 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+ */
+/**
+ * @file scalarproduct/gnunet-service-scalarproduct_common.c
+ * @brief client and set handling shared by the Alice and Bob
+ *        services of the Paillier and the ECC variant
+ * @author Christian M. Fuchs
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include <limits.h>
+#include <gcrypt.h>
+#include "gnunet_util_lib.h"
+#include "gnunet_protocols.h"
+#include "gnunet_scalarproduct_service.h"
+#include "gnunet_set_service.h"
+#include "scalarproduct.h"
+#include "gnunet-service-scalarproduct_common.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "scalarproduct", __VA_ARGS__)
+
+
+/**
+ * Closure for #copy_element_cb().
+ */
+struct SortContext
+{
+  /**
+   * Array we copy to.
+   */
+  struct MpiElement *sorted;
+
+  /**
+   * Number of elements copied so far.
+   */
+  uint32_t count;
+};
+
+
+/**
+ * Add elements our client sent us to the map of elements and to
+ * the set we will intersect.  Elements with a value of 0 do not
+ * contribute to the scalar product and are skipped.
+ *
+ * @param elements map to add to, values are of type
+ *        `struct GNUNET_SCALARPRODUCT_Element *`
+ * @param set set to add the keys to
+ * @param src elements from the client
+ * @param count number of elements in @a src
+ * @return number of elements added
+ */
+uint32_t
+GSP_add_elements (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                  struct GNUNET_SET_Handle *set,
+                  const struct GNUNET_SCALARPRODUCT_Element *src,
+                  uint32_t count)
+{
+  struct GNUNET_SET_Element set_elem;
+  struct GNUNET_SCALARPRODUCT_Element *elem;
+  uint32_t added;
+  uint32_t i;
+
+  added = 0;
+  for (i = 0; i < count; i++)
+  {
+    if (0 == GNUNET_ntohll (src[i].value))
+      continue;
+    elem = GNUNET_new (struct GNUNET_SCALARPRODUCT_Element);
+    memcpy (elem,
+            &src[i],
+            sizeof (struct GNUNET_SCALARPRODUCT_Element));
+    if (GNUNET_SYSERR ==
+        GNUNET_CONTAINER_multihashmap_put (elements,
+                                           &elem->key,
+                                           elem,
+                                           GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY))
+    {
+      /* element with same key encountered twice! */
+      GNUNET_break (0);
+      GNUNET_free (elem);
+      continue;
+    }
+    set_elem.data = &elem->key;
+    set_elem.size = sizeof (elem->key);
+    set_elem.element_type = 0;
+    GNUNET_SET_add_element (set,
+                            &set_elem,
+                            NULL, NULL);
+    added++;
+  }
+  return added;
+}
+
+
+/**
+ * Check a multipart message with further elements from our client.
+ *
+ * @param message the message from the client
+ * @param total total number of elements the client announced
+ * @param received number of elements we already received
+ * @param[out] contained set to the number of elements in @a message
+ * @return the elements in @a message, NULL if it is malformed
+ */
+const struct GNUNET_SCALARPRODUCT_Element *
+GSP_check_client_multipart (const struct GNUNET_MessageHeader *message,
+                            uint32_t total,
+                            uint32_t received,
+                            uint32_t *contained)
+{
+  const struct ComputationBobCryptodataMultipartMessage *msg;
+  uint16_t msize;
+
+  msize = ntohs (message->size);
+  if (msize < sizeof (struct ComputationBobCryptodataMultipartMessage))
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  msg = (const struct ComputationBobCryptodataMultipartMessage *) message;
+  *contained = ntohl (msg->element_count_contained);
+  if ( (msize != (sizeof (struct ComputationBobCryptodataMultipartMessage) +
+                  *contained * sizeof (struct GNUNET_SCALARPRODUCT_Element))) ||
+       (0 == *contained) ||
+       (UINT16_MAX < *contained) ||
+       (total == received) ||
+       (total < received + *contained) )
+  {
+    GNUNET_break_op (0);
+    return NULL;
+  }
+  return (const struct GNUNET_SCALARPRODUCT_Element *) &msg[1];
+}
+
+
+/**
+ * Remove an element the set intersection removed from our map
+ * of elements.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`
+ * @param element the element removed by the intersection
+ */
+void
+GSP_remove_element (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                    const struct GNUNET_SET_Element *element)
+{
+  struct GNUNET_SCALARPRODUCT_Element *se;
+
+  se = GNUNET_CONTAINER_multihashmap_get (elements,
+                                          element->data);
+  GNUNET_assert (NULL != se);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Intersection removed element with key %s and value %lld\n",
+       GNUNET_h2s (&se->key),
+       (long long) GNUNET_ntohll (se->value));
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (elements,
+                                                       element->data,
+                                                       se));
+  GNUNET_free (se);
+}
+
+
+/**
+ * Iterator called to free elements.
+ *
+ * @param cls NULL
+ * @param key the key (unused)
+ * @param value value to free
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_element_cb (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  struct GNUNET_SCALARPRODUCT_Element *e = value;
+
+  GNUNET_free (e);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Free all elements in a map, and the map.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`
+ */
+void
+GSP_free_elements (struct GNUNET_CONTAINER_MultiHashMap *elements)
+{
+  GNUNET_CONTAINER_multihashmap_iterate (elements,
+                                         &free_element_cb,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (elements);
+}
+
+
+/**
+ * Iterator to copy over messages from the hash map
+ * into an array for sorting.
+ *
+ * @param cls the `struct SortContext *`
+ * @param key the key (unused)
+ * @param value the `struct GNUNET_SCALARPRODUCT_Element *`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+copy_element_cb (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  struct SortContext *sc = cls;
+  struct GNUNET_SCALARPRODUCT_Element *e = value;
+  gcry_mpi_t mval;
+  int64_t val;
+
+  mval = gcry_mpi_new (0);
+  val = (int64_t) GNUNET_ntohll (e->value);
+  if (0 > val)
+    gcry_mpi_sub_ui (mval, mval, -val);
+  else
+    gcry_mpi_add_ui (mval, mval, val);
+  sc->sorted[sc->count].value = mval;
+  sc->sorted[sc->count].key = &e->key;
+  sc->count++;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Compare two `struct MpiElement`s by key for sorting.
+ *
+ * @param a pointer to first `struct MpiElement *`
+ * @param b pointer to first `struct MpiElement *`
+ * @return -1 for a < b, 0 for a=b, 1 for a > b.
+ */
+static int
+element_cmp (const void *a,
+             const void *b)
+{
+  const struct MpiElement *ma = a;
+  const struct MpiElement *mb = b;
+
+  return GNUNET_CRYPTO_hash_cmp (ma->key,
+                                 mb->key);
+}
+
+
+/**
+ * Convert the values of the elements to MPIs, sorted by key.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`,
+ *        must not be modified while the result is in use
+ * @param[out] count set to the number of elements in the result
+ * @return array of @a count elements, to be freed with
+ *         #GSP_free_sorted_elements()
+ */
+struct MpiElement *
+GSP_sort_elements (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                   uint32_t *count)
+{
+  struct SortContext sc;
+
+  sc.sorted = GNUNET_new_array (GNUNET_CONTAINER_multihashmap_size (elements) + 1,
+                                struct MpiElement);
+  sc.count = 0;
+  GNUNET_CONTAINER_multihashmap_iterate (elements,
+                                         &copy_element_cb,
+                                         &sc);
+  qsort (sc.sorted,
+         sc.count,
+         sizeof (struct MpiElement),
+         &element_cmp);
+  *count = sc.count;
+  return sc.sorted;
+}
+
+
+/**
+ * Free an array returned by #GSP_sort_elements().
+ *
+ * @param sorted the array, may be NULL
+ * @param count number of elements in @a sorted
+ */
+void
+GSP_free_sorted_elements (struct MpiElement *sorted,
+                          uint32_t count)
+{
+  uint32_t i;
+
+  if (NULL == sorted)
+    return;
+  for (i = 0; i < count; i++)
+    gcry_mpi_release (sorted[i].value);
+  GNUNET_free (sorted);
+}
+
+
+/**
+ * Computes the square sum over a vector of a given length.
+ *
+ * @param vector the vector to compute over
+ * @param length the length of the vector
+ * @return an MPI value containing the calculated sum, never NULL
+ */
+gcry_mpi_t
+GSP_compute_square_sum (const gcry_mpi_t *vector,
+                        uint32_t length)
+{
+  gcry_mpi_t elem;
+  gcry_mpi_t sum;
+  uint32_t i;
+
+  GNUNET_assert (NULL != (sum = gcry_mpi_new (0)));
+  GNUNET_assert (NULL != (elem = gcry_mpi_new (0)));
+  for (i = 0; i < length; i++)
+  {
+    gcry_mpi_mul (elem, vector[i], vector[i]);
+    gcry_mpi_add (sum, sum, elem);
+  }
+  gcry_mpi_release (elem);
+  return sum;
+}
+
+
+/**
+ * Notify our client that the session has ended without a result
+ * (or, for Bob, that the session has ended).
+ *
+ * @param client_mq message queue of the client
+ * @param session_id the session, for logging
+ * @param status the status to report
+ */
+void
+GSP_send_client_end (struct GNUNET_MQ_Handle *client_mq,
+                     const struct GNUNET_HashCode *session_id,
+                     enum GNUNET_SCALARPRODUCT_ResponseStatus status)
+{
+  struct ClientResponseMessage *msg;
+  struct GNUNET_MQ_Envelope *e;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sending session-end notification with status %d to client for session %s\n",
+              status,
+              GNUNET_h2s (session_id));
+  e = GNUNET_MQ_msg (msg,
+                     GNUNET_MESSAGE_TYPE_SCALARPRODUCT_RESULT);
+  msg->range = 0;
+  msg->product_length = htonl (0);
+  msg->status = htonl (status);
+  GNUNET_MQ_send (client_mq,
+                  e);
+}
+
+
+/**
+ * Send the scalar product to Alice's client.
+ *
+ * @param client_mq message queue of the client
+ * @param session_id the session, for logging
+ * @param product the result, if NULL we report a failure
+ */
+void
+GSP_send_client_result (struct GNUNET_MQ_Handle *client_mq,
+                        const struct GNUNET_HashCode *session_id,
+                        gcry_mpi_t product)
+{
+  struct ClientResponseMessage *msg;
+  struct GNUNET_MQ_Envelope *e;
+  unsigned char *product_exported = NULL;
+  size_t product_length = 0;
+  int32_t range;
+  gcry_error_t rc;
+  int sign;
+  gcry_mpi_t value;
+
+  if (NULL == product)
+  {
+    GNUNET_break (0);
+    GSP_send_client_end (client_mq,
+                         session_id,
+                         GNUNET_SCALARPRODUCT_STATUS_FAILURE);
+    return;
+  }
+  value = gcry_mpi_new (0);
+  sign = gcry_mpi_cmp_ui (product, 0);
+  if (0 > sign)
+  {
+    range = -1;
+    gcry_mpi_sub (value,
+                  value,
+                  product);
+  }
+  else if (0 < sign)
+  {
+    range = 1;
+    gcry_mpi_add (value, value, product);
+  }
+  else
+  {
+    /* result is exactly zero */
+    range = 0;
+  }
+  if ( (0 != range) &&
+       (0 != (rc = gcry_mpi_aprint (GCRYMPI_FMT_STD,
+                                    &product_exported,
+                                    &product_length,
+                                    value))))
+  {
+    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR,
+              "gcry_mpi_scan",
+              rc);
+    gcry_mpi_release (value);
+    GSP_send_client_end (client_mq,
+                         session_id,
+                         GNUNET_SCALARPRODUCT_STATUS_FAILURE);
+    return;
+  }
+  gcry_mpi_release (value);
+  e = GNUNET_MQ_msg_extra (msg,
+                           product_length,
+                           GNUNET_MESSAGE_TYPE_SCALARPRODUCT_RESULT);
+  msg->status = htonl (GNUNET_SCALARPRODUCT_STATUS_SUCCESS);
+  msg->range = htonl (range);
+  msg->product_length = htonl (product_length);
+  if (NULL != product_exported)
+  {
+    memcpy (&msg[1],
+            product_exported,
+            product_length);
+    GNUNET_free (product_exported);
+  }
+  GNUNET_MQ_send (client_mq,
+                  e);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sent result to client, session %s has ended!\n",
+              GNUNET_h2s (session_id));
+}
+
+/* end of gnunet-service-scalarproduct_common.c */
@@ -0,0 +1,175 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2013, 2014, 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+ */
+/**
+ * @file scalarproduct/gnunet-service-scalarproduct_common.h
+ * @brief client and set handling shared by the Alice and Bob
+ *        services of the Paillier and the ECC variant
+ * @author Christian M. Fuchs
+ * @author Christian Grothoff
+ */
+#ifndef GNUNET_SERVICE_SCALARPRODUCT_COMMON_H
+#define GNUNET_SERVICE_SCALARPRODUCT_COMMON_H
+
+#include <gcrypt.h>
+#include "gnunet_util_lib.h"
+#include "gnunet_set_service.h"
+#include "gnunet_scalarproduct_service.h"
+
+
+/**
+ * An element key-value pair, with the value as MPI.
+ */
+struct MpiElement
+{
+  /**
+   * Key used to identify matching pairs of values to multiply.
+   * Points into an existing data structure, to avoid copying
+   * and doubling memory use.
+   */
+  const struct GNUNET_HashCode *key;
+
+  /**
+   * Value represented (a or b).
+   */
+  gcry_mpi_t value;
+};
+
+
+/**
+ * Add elements our client sent us to the map of elements and to
+ * the set we will intersect.  Elements with a value of 0 do not
+ * contribute to the scalar product and are skipped.
+ *
+ * @param elements map to add to, values are of type
+ *        `struct GNUNET_SCALARPRODUCT_Element *`
+ * @param set set to add the keys to
+ * @param src elements from the client
+ * @param count number of elements in @a src
+ * @return number of elements added
+ */
+uint32_t
+GSP_add_elements (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                  struct GNUNET_SET_Handle *set,
+                  const struct GNUNET_SCALARPRODUCT_Element *src,
+                  uint32_t count);
+
+
+/**
+ * Check a multipart message with further elements from our client.
+ *
+ * @param message the message from the client
+ * @param total total number of elements the client announced
+ * @param received number of elements we already received
+ * @param[out] contained set to the number of elements in @a message
+ * @return the elements in @a message, NULL if it is malformed
+ */
+const struct GNUNET_SCALARPRODUCT_Element *
+GSP_check_client_multipart (const struct GNUNET_MessageHeader *message,
+                            uint32_t total,
+                            uint32_t received,
+                            uint32_t *contained);
+
+
+/**
+ * Remove an element the set intersection removed from our map
+ * of elements.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`
+ * @param element the element removed by the intersection
+ */
+void
+GSP_remove_element (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                    const struct GNUNET_SET_Element *element);
+
+
+/**
+ * Free all elements in a map, and the map.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`
+ */
+void
+GSP_free_elements (struct GNUNET_CONTAINER_MultiHashMap *elements);
+
+
+/**
+ * Convert the values of the elements to MPIs, sorted by key.
+ *
+ * @param elements map of `struct GNUNET_SCALARPRODUCT_Element *`,
+ *        must not be modified while the result is in use
+ * @param[out] count set to the number of elements in the result
+ * @return array of @a count elements, to be freed with
+ *         #GSP_free_sorted_elements()
+ */
+struct MpiElement *
+GSP_sort_elements (struct GNUNET_CONTAINER_MultiHashMap *elements,
+                   uint32_t *count);
+
+
+/**
+ * Free an array returned by #GSP_sort_elements().
+ *
+ * @param sorted the array, may be NULL
+ * @param count number of elements in @a sorted
+ */
+void
+GSP_free_sorted_elements (struct MpiElement *sorted,
+                          uint32_t count);
+
+
+/**
+ * Computes the square sum over a vector of a given length.
+ *
+ * @param vector the vector to compute over
+ * @param length the length of the vector
+ * @return an MPI value containing the calculated sum, never NULL
+ */
+gcry_mpi_t
+GSP_compute_square_sum (const gcry_mpi_t *vector,
+                        uint32_t length);
+
+
+/**
+ * Notify our client that the session has ended without a result
+ * (or, for Bob, that the session has ended).
+ *
+ * @param client_mq message queue of the client
+ * @param session_id the session, for logging
+ * @param status the status to report
+ */
+void
+GSP_send_client_end (struct GNUNET_MQ_Handle *client_mq,
+                     const struct GNUNET_HashCode *session_id,
+                     enum GNUNET_SCALARPRODUCT_ResponseStatus status);
+
+
+/**
+ * Send the scalar product to Alice's client.
+ *
+ * @param client_mq message queue of the client
+ * @param session_id the session, for logging
+ * @param product the result, if NULL we report a failure
+ */
+void
+GSP_send_client_result (struct GNUNET_MQ_Handle *client_mq,
+                        const struct GNUNET_HashCode *session_id,
+                        gcry_mpi_t product);
+
+
+#endif
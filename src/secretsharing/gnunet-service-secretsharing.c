@@ -108,6 +108,113 @@ struct DecryptPeerInfo
 };
 
 
+struct KeygenSession;
+
+
+/**
+ * Fair encryption of our preshare for one peer, computed in the
+ * crypto offload pool while building our round2 element.
+ */
+struct FairEncryptJob
+{
+  /**
+   * Session the job belongs to.
+   */
+  struct KeygenSession *ks;
+
+  /**
+   * Handle for the job, NULL if not running.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Where to store the result, points into the round2 element.
+   */
+  struct GNUNET_SECRETSHARING_FairEncryption *fe;
+
+  /**
+   * Index of the peer we encrypt for.
+   */
+  unsigned int peer_idx;
+};
+
+
+/**
+ * Possible outcomes of a #Round2Check.
+ */
+enum Round2CheckResult
+{
+  /**
+   * Everything in the element is valid.
+   */
+  ROUND2_CHECK_OK = 0,
+
+  /**
+   * The preshare for our peer does not match its commitment.
+   */
+  ROUND2_CHECK_BAD_PRESHARE,
+
+  /**
+   * The exponentiated preshares do not match the commitments
+   * to the polynomial.
+   */
+  ROUND2_CHECK_BAD_COMMITMENT,
+
+  /**
+   * A proof of fair encryption is invalid.
+   */
+  ROUND2_CHECK_BAD_FAIR_ENCRYPTION
+};
+
+
+/**
+ * Verification of a round2 element of another peer, running in the
+ * crypto offload pool.
+ */
+struct Round2Check
+{
+  /**
+   * Checks are kept in a DLL.
+   */
+  struct Round2Check *next;
+
+  /**
+   * Checks are kept in a DLL.
+   */
+  struct Round2Check *prev;
+
+  /**
+   * Session the element belongs to.
+   */
+  struct KeygenSession *ks;
+
+  /**
+   * Peer that sent the element.
+   */
+  struct KeygenPeerInfo *info;
+
+  /**
+   * Handle for the job, NULL if not running.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Copy of the element's data.
+   */
+  struct GNUNET_SECRETSHARING_KeygenRevealData *d;
+
+  /**
+   * Preshare for our peer, set by the job if it is valid.
+   */
+  gcry_mpi_t preshare;
+
+  /**
+   * Index of the peer whose values were found to be invalid.
+   */
+  unsigned int bad_peer;
+};
+
+
 /**
  * Session to establish a threshold-shared secret.
  */
@@ -215,6 +322,39 @@ struct KeygenSession
    * Public key, will be updated when a round2 element arrives.
    */
   gcry_mpi_t public_key;
+
+  /**
+   * Our round2 element while the fair encryptions for it
+   * are being computed.
+   */
+  struct GNUNET_SET_Element *round2_element;
+
+  /**
+   * Jobs computing the fair encryptions in @e round2_element,
+   * array of size @e num_peers.
+   */
+  struct FairEncryptJob *encrypt_jobs;
+
+  /**
+   * Number of @e encrypt_jobs that did not finish yet.
+   */
+  unsigned int encrypt_jobs_pending;
+
+  /**
+   * Head of the checks of round2 elements in progress.
+   */
+  struct Round2Check *checks_head;
+
+  /**
+   * Tail of the checks of round2 elements in progress.
+   */
+  struct Round2Check *checks_tail;
+
+  /**
+   * #GNUNET_YES once the round2 consensus concluded; we then
+   * only wait for the checks in progress.
+   */
+  int round2_concluded;
 };
 
 
@@ -336,6 +476,37 @@ static const struct GNUNET_CONFIGURATION_Handle *cfg;
  */
 static struct GNUNET_SERVER_Handle *srv;
 
+/**
+ * Maximum number of peer sets we cache Lagrange coefficients for.
+ */
+#define LAGRANGE_CACHE_SIZE 64
+
+/**
+ * Lagrange coefficients for one set of indices.
+ */
+struct LagrangeCacheEntry
+{
+  /**
+   * Indices the coefficients are for.
+   */
+  unsigned int *indices;
+
+  /**
+   * The coefficients, one for each of the @e indices.
+   */
+  gcry_mpi_t *coeffs;
+
+  /**
+   * Number of @e indices.
+   */
+  unsigned int num;
+};
+
+/**
+ * Maps hashes of index sets to `struct LagrangeCacheEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *lagrange_cache;
+
 
 /**
  * Get the peer info belonging to a peer identity in a keygen session.
@@ -549,6 +720,85 @@ compute_lagrange_coefficient (gcry_mpi_t coeff, unsigned int j,
 }
 
 
+/**
+ * Free an entry of the #lagrange_cache.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct LagrangeCacheEntry`
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+free_lagrange_entry (void *cls,
+                     const struct GNUNET_HashCode *key,
+                     void *value)
+{
+  struct LagrangeCacheEntry *le = value;
+  unsigned int i;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (lagrange_cache,
+                                                       key,
+                                                       le));
+  for (i = 0; i < le->num; i++)
+    gcry_mpi_release (le->coeffs[i]);
+  GNUNET_free (le->coeffs);
+  GNUNET_free (le->indices);
+  GNUNET_free (le);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Get the lagrange coefficients for a set of indices.  Decryptions
+ * usually involve the same set of peers, so the coefficients are
+ * cached.
+ *
+ * @param indices indices
+ * @param num number of indices in @a indices
+ * @return array with the @a num coefficients, valid until the next call
+ */
+static const gcry_mpi_t *
+get_lagrange_coefficients (unsigned int *indices,
+                           unsigned int num)
+{
+  struct LagrangeCacheEntry *le;
+  struct GNUNET_HashCode key;
+  unsigned int i;
+
+  GNUNET_CRYPTO_hash (indices, num * sizeof (unsigned int), &key);
+  le = GNUNET_CONTAINER_multihashmap_get (lagrange_cache, &key);
+  if (NULL != le)
+  {
+    if ( (le->num == num) &&
+         (0 == memcmp (le->indices, indices, num * sizeof (unsigned int))) )
+      return le->coeffs;
+    /* hash collision, replace the old entry */
+    free_lagrange_entry (NULL, &key, le);
+  }
+  if (GNUNET_CONTAINER_multihashmap_size (lagrange_cache) >= LAGRANGE_CACHE_SIZE)
+    GNUNET_CONTAINER_multihashmap_iterate (lagrange_cache,
+                                           &free_lagrange_entry,
+                                           NULL);
+  le = GNUNET_new (struct LagrangeCacheEntry);
+  le->num = num;
+  le->indices = GNUNET_new_array (num, unsigned int);
+  memcpy (le->indices, indices, num * sizeof (unsigned int));
+  le->coeffs = GNUNET_new_array (num, gcry_mpi_t);
+  for (i = 0; i < num; i++)
+  {
+    GNUNET_assert (NULL != (le->coeffs[i] = gcry_mpi_new (0)));
+    compute_lagrange_coefficient (le->coeffs[i], indices[i], indices, num);
+  }
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (lagrange_cache,
+                                                    &key,
+                                                    le,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return le->coeffs;
+}
+
+
 /**
  * Destroy a decrypt session, removing it from
  * the linked list of decrypt sessions.
@@ -626,6 +876,30 @@ keygen_info_destroy (struct KeygenPeerInfo *info)
 }
 
 
+/**
+ * Destroy a check of a round2 element, cancelling its job.
+ *
+ * @param rc check to destroy
+ */
+static void
+round2_check_destroy (struct Round2Check *rc)
+{
+  GNUNET_CONTAINER_DLL_remove (rc->ks->checks_head, rc->ks->checks_tail, rc);
+  if (NULL != rc->job)
+  {
+    GNUNET_CRYPTO_offload_cancel (rc->job);
+    rc->job = NULL;
+  }
+  if (NULL != rc->preshare)
+  {
+    gcry_mpi_release (rc->preshare);
+    rc->preshare = NULL;
+  }
+  GNUNET_free (rc->d);
+  GNUNET_free (rc);
+}
+
+
 static void
 keygen_session_destroy (struct KeygenSession *ks)
 {
@@ -633,6 +907,22 @@ keygen_session_destroy (struct KeygenSession *ks)
 
   GNUNET_CONTAINER_DLL_remove (keygen_sessions_head, keygen_sessions_tail, ks);
 
+  /* the jobs use the session's data, so stop them first */
+  while (NULL != ks->checks_head)
+    round2_check_destroy (ks->checks_head);
+
+  if (NULL != ks->encrypt_jobs)
+  {
+    unsigned int i;
+    for (i = 0; i < ks->num_peers; i++)
+      if (NULL != ks->encrypt_jobs[i].job)
+        GNUNET_CRYPTO_offload_cancel (ks->encrypt_jobs[i].job);
+    GNUNET_free (ks->encrypt_jobs);
+    ks->encrypt_jobs = NULL;
+  }
+  GNUNET_free_non_null (ks->round2_element);
+  ks->round2_element = NULL;
+
   if (NULL != ks->info)
   {
     unsigned int i;
@@ -710,6 +1000,15 @@ cleanup_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
   while (NULL != keygen_sessions_head)
     keygen_session_destroy (keygen_sessions_head);
+
+  if (NULL != lagrange_cache)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (lagrange_cache,
+                                           &free_lagrange_entry,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (lagrange_cache);
+    lagrange_cache = NULL;
+  }
 }
 
 
@@ -830,10 +1129,15 @@ horner_eval (gcry_mpi_t z, gcry_mpi_t *coeff, unsigned int num_coeff, gcry_mpi_t
 }
 
 
+/**
+ * The second round concluded and all its elements were checked.
+ * Send the share to the client.
+ *
+ * @param ks the session
+ */
 static void
-keygen_round2_conclude (void *cls)
+keygen_round2_finish (struct KeygenSession *ks)
 {
-  struct KeygenSession *ks = cls;
   struct GNUNET_SECRETSHARING_SecretReadyMessage *m;
   struct GNUNET_MQ_Envelope *ev;
   size_t share_size;
@@ -841,11 +1145,6 @@ keygen_round2_conclude (void *cls)
   unsigned int j;
   struct GNUNET_SECRETSHARING_Share *share;
 
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO, "round2 conclude\n");
-
-  GNUNET_CONSENSUS_destroy (ks->consensus);
-  ks->consensus = NULL;
-
   share = GNUNET_new (struct GNUNET_SECRETSHARING_Share);
 
   share->num_peers = 0;
@@ -910,7 +1209,38 @@ keygen_round2_conclude (void *cls)
 }
 
 
+/**
+ * Called when the second consensus round has concluded.  Elements
+ * may still be checked in the offload pool; in that case, the share
+ * is sent once the last check is done.
+ *
+ * @param cls closure
+ */
+static void
+keygen_round2_conclude (void *cls)
+{
+  struct KeygenSession *ks = cls;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO, "round2 conclude\n");
 
+  GNUNET_CONSENSUS_destroy (ks->consensus);
+  ks->consensus = NULL;
+  ks->round2_concluded = GNUNET_YES;
+  if (NULL == ks->checks_head)
+    keygen_round2_finish (ks);
+}
+
+
+/**
+ * Restore the plaintext of a fair encryption.  Like the other proof
+ * functions below, this runs in the crypto offload pool and must thus
+ * neither log nor modify shared state.
+ *
+ * @param ppub paillier public key of the recipient
+ * @param fe the fair encryption
+ * @param x decryption of @a fe
+ * @param[out] xres restored plaintext
+ */
 static void
 restore_fair (const struct GNUNET_CRYPTO_PaillierPublicKey *ppub,
               const struct GNUNET_SECRETSHARING_FairEncryption *fe,
@@ -1090,7 +1420,7 @@ verify_fair (const struct GNUNET_CRYPTO_PaillierPublicKey *ppub, const struct GN
 
   if (0 == gcry_mpi_cmp (t1, tmp1))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "fair encryption invalid (t1)\n");
+    /* fair encryption invalid (t1) */
     res = GNUNET_NO;
     goto cleanup;
   }
@@ -1109,7 +1439,7 @@ verify_fair (const struct GNUNET_CRYPTO_PaillierPublicKey *ppub, const struct GN
 
   if (0 == gcry_mpi_cmp (t2, tmp1))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "fair encryption invalid (t2)\n");
+    /* fair encryption invalid (t2) */
     res = GNUNET_NO;
     goto cleanup;
   }
@@ -1248,6 +1578,120 @@ encrypt_fair (gcry_mpi_t v, const struct GNUNET_CRYPTO_PaillierPublicKey *ppub,
 }
 
 
+/**
+ * Compute the fair encryption of our preshare for one peer,
+ * run in the crypto offload pool.
+ *
+ * @param cls the `struct FairEncryptJob`
+ * @return #GNUNET_OK
+ */
+static int
+fair_encrypt_job (void *cls)
+{
+  struct FairEncryptJob *fj = cls;
+  struct KeygenSession *ks = fj->ks;
+  gcry_mpi_t idx;
+  gcry_mpi_t v;
+
+  GNUNET_assert (NULL != (v = gcry_mpi_new (GNUNET_SECRETSHARING_ELGAMAL_BITS)));
+  GNUNET_assert (NULL != (idx = gcry_mpi_new (GNUNET_SECRETSHARING_ELGAMAL_BITS)));
+  gcry_mpi_set_ui (idx, fj->peer_idx + 1);
+  // evaluate the polynomial
+  horner_eval (v, ks->presecret_polynomial, ks->threshold, idx, elgamal_q);
+  // encrypt the result
+  encrypt_fair (v, &ks->info[fj->peer_idx].paillier_public_key, fj->fe);
+  gcry_mpi_release (v);
+  gcry_mpi_release (idx);
+  return GNUNET_OK;
+}
+
+
+/**
+ * All fair encryptions of our round2 element are done.  Add the
+ * exponentiated coefficients, sign the element, insert it in the
+ * consensus and conclude.
+ *
+ * @param ks session to use
+ */
+static void
+insert_round2_element_finish (struct KeygenSession *ks)
+{
+  struct GNUNET_SET_Element *element = ks->round2_element;
+  struct GNUNET_SECRETSHARING_KeygenRevealData *d;
+  unsigned char *pos;
+  unsigned char *last_pos;
+  size_t element_size;
+  unsigned int i;
+  gcry_mpi_t v;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: computed enc preshares\n",
+              ks->local_peer_idx);
+
+  GNUNET_free (ks->encrypt_jobs);
+  ks->encrypt_jobs = NULL;
+  ks->round2_element = NULL;
+  element_size = element->size;
+  d = (void *) element->data;
+  pos = (void *) &d[1];
+  last_pos = pos + element_size;
+  // skip encrypted pre-shares
+  pos += sizeof (struct GNUNET_SECRETSHARING_FairEncryption) * ks->num_peers;
+
+  GNUNET_assert (NULL != (v = gcry_mpi_new (GNUNET_SECRETSHARING_ELGAMAL_BITS)));
+
+  // exponentiated coefficients
+  for (i = 0; i < ks->threshold; i++)
+  {
+    ptrdiff_t remaining = last_pos - pos;
+    GNUNET_assert (remaining > 0);
+    gcry_mpi_powm (v, elgamal_g, ks->presecret_polynomial[i], elgamal_p);
+    GNUNET_CRYPTO_mpi_print_unsigned (pos, GNUNET_SECRETSHARING_ELGAMAL_BITS / 8, v);
+    pos += GNUNET_SECRETSHARING_ELGAMAL_BITS / 8;
+  }
+
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: computed exp coefficients\n",
+              ks->local_peer_idx);
+
+
+  d->purpose.size = htonl (element_size - offsetof (struct GNUNET_SECRETSHARING_KeygenRevealData, purpose));
+  d->purpose.purpose = htonl (GNUNET_SIGNATURE_PURPOSE_SECRETSHARING_DKG2);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CRYPTO_eddsa_sign (my_peer_private_key,
+                                           &d->purpose,
+                                           &d->signature));
+
+  GNUNET_CONSENSUS_insert (ks->consensus, element, NULL, NULL);
+  GNUNET_free (element); /* FIXME: maybe stack-allocate instead? */
+
+  gcry_mpi_release (v);
+
+  GNUNET_CONSENSUS_conclude (ks->consensus,
+                             keygen_round2_conclude,
+                             ks);
+}
+
+
+/**
+ * A fair encryption for our round2 element is done.
+ *
+ * @param cls the `struct FairEncryptJob`
+ * @param result #GNUNET_OK
+ */
+static void
+fair_encrypt_done (void *cls,
+                   int result)
+{
+  struct FairEncryptJob *fj = cls;
+  struct KeygenSession *ks = fj->ks;
+
+  fj->job = NULL;
+  GNUNET_assert (0 < ks->encrypt_jobs_pending);
+  ks->encrypt_jobs_pending--;
+  if (0 == ks->encrypt_jobs_pending)
+    insert_round2_element_finish (ks);
+}
+
+
 /**
  * Insert round 2 element in the consensus, consisting of
  * (1) The exponentiated pre-share polynomial coefficients A_{i,l}=g^{a_{i,l}}
@@ -1256,6 +1700,10 @@ encrypt_fair (gcry_mpi_t v, const struct GNUNET_CRYPTO_PaillierPublicKey *ppub,
  * (4) The zero knowledge proof for fairness of
  *     the encryption
  *
+ * The encryptions and proofs for the peers are computed in parallel
+ * in the crypto offload pool; once they are all done, the element is
+ * inserted and the round is concluded.
+ *
  * @param ks session to use
  */
 static void
@@ -1267,15 +1715,10 @@ insert_round2_element (struct KeygenSession *ks)
   unsigned char *last_pos;
   size_t element_size;
   unsigned int i;
-  gcry_mpi_t idx;
-  gcry_mpi_t v;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: Inserting round2 element\n",
               ks->local_peer_idx);
 
-  GNUNET_assert (NULL != (v = gcry_mpi_new (GNUNET_SECRETSHARING_ELGAMAL_BITS)));
-  GNUNET_assert (NULL != (idx = gcry_mpi_new (GNUNET_SECRETSHARING_ELGAMAL_BITS)));
-
   element_size = (sizeof (struct GNUNET_SECRETSHARING_KeygenRevealData) +
                   sizeof (struct GNUNET_SECRETSHARING_FairEncryption) * ks->num_peers +
                   GNUNET_SECRETSHARING_ELGAMAL_BITS / 8 * ks->threshold);
@@ -1292,60 +1735,36 @@ insert_round2_element (struct KeygenSession *ks)
   pos = (void *) &d[1];
   last_pos = pos + element_size;
 
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: computed exp preshares\n",
-              ks->local_peer_idx);
+  ks->round2_element = element;
+  ks->encrypt_jobs = GNUNET_new_array (ks->num_peers, struct FairEncryptJob);
+  ks->encrypt_jobs_pending = 0;
 
   // encrypted pre-shares
   // and fair encryption proof
-  {
-    for (i = 0; i < ks->num_peers; i++)
-    {
-      ptrdiff_t remaining = last_pos - pos;
-      struct GNUNET_SECRETSHARING_FairEncryption *fe = (void *) pos;
-
-      GNUNET_assert (remaining > 0);
-      memset (fe, 0, sizeof *fe);
-      if (GNUNET_YES == ks->info[i].round1_valid)
-      {
-        gcry_mpi_set_ui (idx, i + 1);
-        // evaluate the polynomial
-        horner_eval (v, ks->presecret_polynomial, ks->threshold, idx, elgamal_q);
-        // encrypt the result
-        encrypt_fair (v, &ks->info[i].paillier_public_key, fe);
-      }
-      pos += sizeof *fe;
-    }
-  }
-
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: computed enc preshares\n",
-              ks->local_peer_idx);
-
-  // exponentiated coefficients
-  for (i = 0; i < ks->threshold; i++)
+  for (i = 0; i < ks->num_peers; i++)
   {
     ptrdiff_t remaining = last_pos - pos;
+    struct GNUNET_SECRETSHARING_FairEncryption *fe = (void *) pos;
+
     GNUNET_assert (remaining > 0);
-    gcry_mpi_powm (v, elgamal_g, ks->presecret_polynomial[i], elgamal_p);
-    GNUNET_CRYPTO_mpi_print_unsigned (pos, GNUNET_SECRETSHARING_ELGAMAL_BITS / 8, v);
-    pos += GNUNET_SECRETSHARING_ELGAMAL_BITS / 8;
+    memset (fe, 0, sizeof *fe);
+    if (GNUNET_YES == ks->info[i].round1_valid)
+    {
+      struct FairEncryptJob *fj = &ks->encrypt_jobs[i];
+
+      fj->ks = ks;
+      fj->fe = fe;
+      fj->peer_idx = i;
+      ks->encrypt_jobs_pending++;
+      fj->job = GNUNET_CRYPTO_offload (&fair_encrypt_job,
+                                       fj,
+                                       &fair_encrypt_done,
+                                       fj);
+    }
+    pos += sizeof *fe;
   }
-
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "P%u: computed exp coefficients\n",
-              ks->local_peer_idx);
-
-
-  d->purpose.size = htonl (element_size - offsetof (struct GNUNET_SECRETSHARING_KeygenRevealData, purpose));
-  d->purpose.purpose = htonl (GNUNET_SIGNATURE_PURPOSE_SECRETSHARING_DKG2);
-  GNUNET_assert (GNUNET_OK ==
-                 GNUNET_CRYPTO_eddsa_sign (my_peer_private_key,
-                                           &d->purpose,
-                                           &d->signature));
-
-  GNUNET_CONSENSUS_insert (ks->consensus, element, NULL, NULL);
-  GNUNET_free (element); /* FIXME: maybe stack-allocate instead? */
-
-  gcry_mpi_release (v);
-  gcry_mpi_release (idx);
+  if (0 == ks->encrypt_jobs_pending)
+    insert_round2_element_finish (ks);
 }
 
 
@@ -1401,6 +1820,189 @@ keygen_reveal_get_exp_preshare (struct KeygenSession *ks,
 }
 
 
+/**
+ * Check that the exponentiated preshares y_j in @a d match the
+ * exponentiated coefficients A_k, that is y_j = prod_k A_k^{(j+1)^k}.
+ * The product is a multi-exponentiation that we evaluate with Horner's
+ * scheme in the exponent, y_j = (...(A_{t-1}^{j+1} A_{t-2})^{j+1} ...) A_0,
+ * so each peer costs threshold-1 exponentiations with tiny exponents.
+ *
+ * @param ks session of the element
+ * @param d the element
+ * @param[out] bad_peer set to the first peer whose value does not match
+ * @return #GNUNET_OK if all values match
+ */
+static int
+check_commitments (struct KeygenSession *ks,
+                   const struct GNUNET_SECRETSHARING_KeygenRevealData *d,
+                   unsigned int *bad_peer)
+{
+  gcry_mpi_t exp_coeffs[ks->threshold];
+  gcry_mpi_t prod;
+  gcry_mpi_t x;
+  gcry_mpi_t exp_preshare;
+  unsigned int j;
+  unsigned int k;
+  int ret;
+
+  for (k = 0; k < ks->threshold; k++)
+    exp_coeffs[k] = keygen_reveal_get_exp_coeff (ks, d, k);
+  GNUNET_assert (NULL != (prod = gcry_mpi_new (0)));
+  GNUNET_assert (NULL != (x = gcry_mpi_new (0)));
+  ret = GNUNET_OK;
+  for (j = 0; j < ks->num_peers; j++)
+  {
+    // We count players from 1, but shares from 0.
+    gcry_mpi_set_ui (x, j + 1);
+    gcry_mpi_set (prod, exp_coeffs[ks->threshold - 1]);
+    for (k = ks->threshold - 1; k > 0; k--)
+    {
+      gcry_mpi_powm (prod, prod, x, elgamal_p);
+      gcry_mpi_mulm (prod, prod, exp_coeffs[k - 1], elgamal_p);
+    }
+    gcry_mpi_mod (prod, prod, elgamal_p);
+    exp_preshare = keygen_reveal_get_exp_preshare (ks, d, j);
+    gcry_mpi_mod (exp_preshare, exp_preshare, elgamal_p);
+    if (0 != gcry_mpi_cmp (prod, exp_preshare))
+    {
+      *bad_peer = j;
+      ret = GNUNET_SYSERR;
+    }
+    gcry_mpi_release (exp_preshare);
+    if (GNUNET_OK != ret)
+      break;
+  }
+  for (k = 0; k < ks->threshold; k++)
+    gcry_mpi_release (exp_coeffs[k]);
+  gcry_mpi_release (prod);
+  gcry_mpi_release (x);
+  return ret;
+}
+
+
+/**
+ * Verify a round2 element, run in the crypto offload pool.
+ *
+ * @param cls the `struct Round2Check`
+ * @return an `enum Round2CheckResult`
+ */
+static int
+round2_check_job (void *cls)
+{
+  struct Round2Check *rc = cls;
+  struct KeygenSession *ks = rc->ks;
+  struct GNUNET_SECRETSHARING_FairEncryption *fe;
+  gcry_mpi_t preshare;
+  gcry_mpi_t tmp;
+  unsigned int j;
+  int cmp_result;
+
+  fe = keygen_reveal_get_enc_preshare (ks, rc->d, ks->local_peer_idx);
+  GNUNET_assert (NULL != (preshare = gcry_mpi_new (0)));
+  GNUNET_CRYPTO_paillier_decrypt (&ks->paillier_private_key,
+                                  &ks->info[ks->local_peer_idx].paillier_public_key,
+                                  &fe->c,
+                                  preshare);
+
+  // FIXME: not doing the restoration is less expensive
+  restore_fair (&ks->info[ks->local_peer_idx].paillier_public_key,
+                fe,
+                preshare,
+                preshare);
+
+  GNUNET_assert (NULL != (tmp = gcry_mpi_new (0)));
+  gcry_mpi_powm (tmp, elgamal_g, preshare, elgamal_p);
+  cmp_result = gcry_mpi_cmp (tmp, rc->info->preshare_commitment);
+  gcry_mpi_release (tmp);
+  if (0 != cmp_result)
+  {
+    gcry_mpi_release (preshare);
+    return ROUND2_CHECK_BAD_PRESHARE;
+  }
+  rc->preshare = preshare;
+
+  // validate that the polynomial sharing matches the additive sharing
+  if (GNUNET_OK != check_commitments (ks, rc->d, &rc->bad_peer))
+    return ROUND2_CHECK_BAD_COMMITMENT;
+
+  // TODO: verify proof of fair encryption (once implemented)
+  for (j = 0; j < ks->num_peers; j++)
+  {
+    fe = keygen_reveal_get_enc_preshare (ks, rc->d, j);
+    if (GNUNET_YES != verify_fair (&ks->info[j].paillier_public_key, fe))
+    {
+      rc->bad_peer = j;
+      return ROUND2_CHECK_BAD_FAIR_ENCRYPTION;
+    }
+  }
+  return ROUND2_CHECK_OK;
+}
+
+
+/**
+ * Verification of a round2 element is done, apply its values.
+ *
+ * @param cls the `struct Round2Check`
+ * @param result an `enum Round2CheckResult`
+ */
+static void
+round2_check_done (void *cls,
+                   int result)
+{
+  struct Round2Check *rc = cls;
+  struct KeygenSession *ks = rc->ks;
+  struct KeygenPeerInfo *info = rc->info;
+  unsigned int j;
+
+  rc->job = NULL;
+  if (ROUND2_CHECK_BAD_PRESHARE == result)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: Got invalid presecret from P%u\n",
+                (unsigned int) ks->local_peer_idx, (unsigned int) (info - ks->info));
+  }
+  else
+  {
+    if (NULL == ks->my_share)
+    {
+      GNUNET_assert (NULL != (ks->my_share = gcry_mpi_new (0)));
+    }
+    gcry_mpi_addm (ks->my_share, ks->my_share, rc->preshare, elgamal_q);
+
+    for (j = 0; j < ks->num_peers; j++)
+    {
+      gcry_mpi_t presigma;
+      if (NULL == ks->info[j].sigma)
+      {
+        GNUNET_assert (NULL != (ks->info[j].sigma = gcry_mpi_new (0)));
+        gcry_mpi_set_ui (ks->info[j].sigma, 1);
+      }
+      presigma = keygen_reveal_get_exp_preshare (ks, rc->d, j);
+      gcry_mpi_mulm (ks->info[j].sigma, ks->info[j].sigma, presigma, elgamal_p);
+      gcry_mpi_release (presigma);
+    }
+
+    switch (result)
+    {
+    case ROUND2_CHECK_BAD_COMMITMENT:
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: reveal data from P%u incorrect\n",
+                  ks->local_peer_idx, rc->bad_peer);
+      break;
+    case ROUND2_CHECK_BAD_FAIR_ENCRYPTION:
+      GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: reveal data from P%u incorrect (fair encryption)\n",
+                  ks->local_peer_idx, rc->bad_peer);
+      break;
+    default:
+      info->round2_valid = GNUNET_YES;
+      break;
+    }
+  }
+  round2_check_destroy (rc);
+  if ( (GNUNET_YES == ks->round2_concluded) &&
+       (NULL == ks->checks_head) )
+    keygen_round2_finish (ks);
+}
+
+
 static void
 keygen_round2_new_element (void *cls,
                            const struct GNUNET_SET_Element *element)
@@ -1408,12 +2010,9 @@ keygen_round2_new_element (void *cls,
   struct KeygenSession *ks = cls;
   const struct GNUNET_SECRETSHARING_KeygenRevealData *d;
   struct KeygenPeerInfo *info;
+  struct Round2Check *rc;
   size_t expected_element_size;
-  unsigned int j;
-  int cmp_result;
-  gcry_mpi_t tmp;
   gcry_mpi_t public_key_share;
-  gcry_mpi_t preshare;
 
   if (NULL == element)
   {
@@ -1453,7 +2052,11 @@ keygen_round2_new_element (void *cls,
     return;
   }
 
-  if (GNUNET_YES == info->round2_valid)
+  for (rc = ks->checks_head; NULL != rc; rc = rc->next)
+    if (rc->info == info)
+      break;
+  if ( (GNUNET_YES == info->round2_valid) ||
+       (NULL != rc) )
   {
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
                 "ignoring duplicate round2 element (%s)\n",
@@ -1478,6 +2081,8 @@ keygen_round2_new_element (void *cls,
   }
 
   public_key_share = keygen_reveal_get_exp_coeff (ks, d, 0);
+  if (NULL != info->preshare_commitment)
+    gcry_mpi_release (info->preshare_commitment);
   info->preshare_commitment = keygen_reveal_get_exp_preshare (ks, d, ks->local_peer_idx);
 
   if (NULL == ks->public_key)
@@ -1490,107 +2095,17 @@ keygen_round2_new_element (void *cls,
   gcry_mpi_release (public_key_share);
   public_key_share = NULL;
 
-  {
-    struct GNUNET_SECRETSHARING_FairEncryption *fe = keygen_reveal_get_enc_preshare (ks, d, ks->local_peer_idx);
-    GNUNET_assert (NULL != (preshare = gcry_mpi_new (0)));
-    GNUNET_CRYPTO_paillier_decrypt (&ks->paillier_private_key,
-                                    &ks->info[ks->local_peer_idx].paillier_public_key,
-                                    &fe->c,
-                                    preshare);
-
-    // FIXME: not doing the restoration is less expensive
-    restore_fair (&ks->info[ks->local_peer_idx].paillier_public_key,
-                  fe,
-                  preshare,
-                  preshare);
-  }
-
-  GNUNET_assert (NULL != (tmp = gcry_mpi_new (0)));
-  gcry_mpi_powm (tmp, elgamal_g, preshare, elgamal_p);
-
-  cmp_result = gcry_mpi_cmp (tmp, info->preshare_commitment);
-  gcry_mpi_release (tmp);
-  tmp = NULL;
-  if (0 != cmp_result)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: Got invalid presecret from P%u\n",
-                (unsigned int) ks->local_peer_idx, (unsigned int) (info - ks->info));
-    return;
-  }
-
-  if (NULL == ks->my_share)
-  {
-    GNUNET_assert (NULL != (ks->my_share = gcry_mpi_new (0)));
-  }
-  gcry_mpi_addm (ks->my_share, ks->my_share, preshare, elgamal_q);
-
-  for (j = 0; j < ks->num_peers; j++)
-  {
-    gcry_mpi_t presigma;
-    if (NULL == ks->info[j].sigma)
-    {
-      GNUNET_assert (NULL != (ks->info[j].sigma = gcry_mpi_new (0)));
-      gcry_mpi_set_ui (ks->info[j].sigma, 1);
-    }
-    presigma = keygen_reveal_get_exp_preshare (ks, d, j);
-    gcry_mpi_mulm (ks->info[j].sigma, ks->info[j].sigma, presigma, elgamal_p);
-    gcry_mpi_release (presigma);
-  }
-
-  gcry_mpi_t prod;
-  GNUNET_assert (NULL != (prod = gcry_mpi_new (0)));
-  gcry_mpi_t j_to_k;
-  GNUNET_assert (NULL != (j_to_k = gcry_mpi_new (0)));
-  // validate that the polynomial sharing matches the additive sharing
-  for (j = 0; j < ks->num_peers; j++)
-  {
-    unsigned int k;
-    int cmp_result;
-    gcry_mpi_t exp_preshare;
-    gcry_mpi_set_ui (prod, 1);
-    for (k = 0; k < ks->threshold; k++)
-    {
-      // Using pow(double,double) is a bit sketchy.
-      // We count players from 1, but shares from 0.
-      gcry_mpi_t tmp;
-      gcry_mpi_set_ui (j_to_k, (unsigned int) pow(j+1, k));
-      tmp = keygen_reveal_get_exp_coeff (ks, d, k);
-      gcry_mpi_powm (tmp, tmp, j_to_k, elgamal_p);
-      gcry_mpi_mulm (prod, prod, tmp, elgamal_p);
-      gcry_mpi_release (tmp);
-    }
-    exp_preshare = keygen_reveal_get_exp_preshare (ks, d, j);
-    gcry_mpi_mod (exp_preshare, exp_preshare, elgamal_p);
-    cmp_result = gcry_mpi_cmp (prod, exp_preshare);
-    gcry_mpi_release (exp_preshare);
-    exp_preshare = NULL;
-    if (0 != cmp_result)
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: reveal data from P%u incorrect\n",
-                  ks->local_peer_idx, j);
-      /* no need for further verification, round2 stays invalid ... */
-      return;
-    }
-  }
-
-  // TODO: verify proof of fair encryption (once implemented)
-  for (j = 0; j < ks->num_peers; j++)
-  {
-    struct GNUNET_SECRETSHARING_FairEncryption *fe = keygen_reveal_get_enc_preshare (ks, d, j);
-    if (GNUNET_YES != verify_fair (&ks->info[j].paillier_public_key, fe))
-    {
-      GNUNET_log (GNUNET_ERROR_TYPE_WARNING, "P%u: reveal data from P%u incorrect (fair encryption)\n",
-                  ks->local_peer_idx, j);
-      return;
-    }
-
-  }
-
-  info->round2_valid = GNUNET_YES;
-
-  gcry_mpi_release (preshare);
-  gcry_mpi_release (prod);
-  gcry_mpi_release (j_to_k);
+  /* the expensive checks run in parallel in the offload pool */
+  rc = GNUNET_new (struct Round2Check);
+  rc->ks = ks;
+  rc->info = info;
+  rc->d = GNUNET_malloc (element->size);
+  memcpy (rc->d, d, element->size);
+  GNUNET_CONTAINER_DLL_insert (ks->checks_head, ks->checks_tail, rc);
+  rc->job = GNUNET_CRYPTO_offload (&round2_check_job,
+                                   rc,
+                                   &round2_check_done,
+                                   rc);
 }
 
 
@@ -1613,10 +2128,6 @@ keygen_round1_conclude (void *cls)
                                            keygen_round2_new_element, ks);
 
   insert_round2_element (ks);
-
-  GNUNET_CONSENSUS_conclude (ks->consensus,
-                             keygen_round2_conclude,
-                             ks);
 }
 
 
@@ -1747,7 +2258,7 @@ decrypt_conclude (void *cls)
   struct DecryptSession *ds = cls;
   struct GNUNET_SECRETSHARING_DecryptResponseMessage *msg;
   struct GNUNET_MQ_Envelope *ev;
-  gcry_mpi_t lagrange;
+  const gcry_mpi_t *lagrange;
   gcry_mpi_t m;
   gcry_mpi_t tmp;
   gcry_mpi_t c_2;
@@ -1760,7 +2271,6 @@ decrypt_conclude (void *cls)
   GNUNET_CONSENSUS_destroy (ds->consensus);
   ds->consensus = NULL;
 
-  GNUNET_assert (0 != (lagrange = gcry_mpi_new (0)));
   GNUNET_assert (0 != (m = gcry_mpi_new (0)));
   GNUNET_assert (0 != (tmp = gcry_mpi_new (0)));
   GNUNET_assert (0 != (prod = gcry_mpi_new (0)));
@@ -1779,15 +2289,15 @@ decrypt_conclude (void *cls)
   GNUNET_log (GNUNET_ERROR_TYPE_INFO, "P%u: decrypt conclude, with %u peers\n",
               ds->share->my_peer, num);
 
+  lagrange = get_lagrange_coefficients (indices, num);
   gcry_mpi_set_ui (prod, 1);
   for (i = 0; i < num; i++)
   {
 
     GNUNET_log (GNUNET_ERROR_TYPE_INFO, "P%u: index of %u: %u\n",
                 ds->share->my_peer, i, indices[i]);
-    compute_lagrange_coefficient (lagrange, indices[i], indices, num);
     // w_i^{\lambda_i}
-    gcry_mpi_powm (tmp, ds->info[indices[i]].partial_decryption, lagrange, elgamal_p);
+    gcry_mpi_powm (tmp, ds->info[indices[i]].partial_decryption, lagrange[i], elgamal_p);
 
     // product of all exponentiated partiel decryptions ...
     gcry_mpi_mulm (prod, prod, tmp, elgamal_p);
@@ -1806,7 +2316,6 @@ decrypt_conclude (void *cls)
 
   GNUNET_free (indices);
 
-  gcry_mpi_release(lagrange);
   gcry_mpi_release(m);
   gcry_mpi_release(tmp);
   gcry_mpi_release(prod);
@@ -2246,6 +2755,8 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
     return;
   }
   init_crypto_constants ();
+  lagrange_cache = GNUNET_CONTAINER_multihashmap_create (LAGRANGE_CACHE_SIZE,
+                                                         GNUNET_NO);
   if (GNUNET_OK != GNUNET_CRYPTO_get_peer_identity (cfg, &my_peer))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "could not retrieve host identity\n");
@@ -85,6 +85,7 @@ stop ()
     SENSOR_reporting_stop ();
   if (GNUNET_YES == start_monitoring)
     SENSOR_monitoring_stop ();
+  SENSOR_timeseries_stop ();
   GNUNET_SENSOR_destroy_sensors (sensors);
 }
 
@@ -284,6 +285,7 @@ static void
 start ()
 {
   sensors = GNUNET_SENSOR_load_all_sensors (sensor_dir);
+  SENSOR_timeseries_start (cfg, sensors);
   if (GNUNET_YES == start_monitoring)
     SENSOR_monitoring_start (cfg, sensors);
   if (GNUNET_YES == start_reporting)
@@ -169,6 +169,7 @@ sensor_statistics_iterator (void *cls, const char *ss, const char *name,
   GNUNET_PEERSTORE_store (peerstore, "sensor", &peerid, sensorinfo->name,
                           &dvalue, sizeof (dvalue), expiry,
                           GNUNET_PEERSTORE_STOREOPTION_MULTIPLE, NULL, NULL);
+  SENSOR_timeseries_add (sensorinfo, &dvalue, sizeof (dvalue));
   return GNUNET_SYSERR;         /* We only want one value */
 }
 
@@ -275,6 +276,7 @@ sensor_process_callback (void *cls, const char *line)
     GNUNET_PEERSTORE_store (peerstore, "sensor", &peerid, sensorinfo->name,
                             value, valsize, expiry,
                             GNUNET_PEERSTORE_STOREOPTION_MULTIPLE, NULL, NULL);
+    SENSOR_timeseries_add (sensorinfo, value, valsize);
     GNUNET_free (value);
   }
 }
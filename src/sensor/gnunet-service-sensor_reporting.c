@@ -30,6 +30,7 @@
 #include "gnunet_core_service.h"
 #include "gnunet_cadet_service.h"
 #include "gnunet_applications.h"
+#include <zlib.h>
 
 #define LOG(kind,...) GNUNET_log_from (kind, "sensor-reporting",__VA_ARGS__)
 
@@ -38,6 +39,17 @@
  */
 #define CP_RETRY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 1)
 
+/**
+ * Default time to wait for more values before sending a batch to a
+ * collection point
+ */
+#define DEFAULT_BATCH_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
+/**
+ * Maximum size of the (uncompressed) entries of a value batch message
+ */
+#define MAX_BATCH_SIZE (GNUNET_SERVER_MAX_MESSAGE_SIZE - 1 - sizeof (struct GNUNET_SENSOR_ValueBatchMessage))
+
 
 /**
  * When we are still generating a proof-of-work and we need to send an anomaly
@@ -137,29 +149,10 @@ struct ValueInfo
   struct GNUNET_SENSOR_SensorInfo *sensor;
 
   /**
-   * Last value read from sensor
-   */
-  void *last_value;
-
-  /**
-   * Size of @e last_value
-   */
-  size_t last_value_size;
-
-  /**
-   * Timestamp of last value reading
-   */
-  struct GNUNET_TIME_Absolute last_value_timestamp;
-
-  /**
-   * Has the last value seen already been reported to collection point?
-   */
-  int last_value_reported;
-
-  /**
-   * Watcher of sensor values
+   * Timestamp of the last reading reported to the collection point, the
+   * next report covers the readings taken after it
    */
-  struct GNUNET_PEERSTORE_WatchContext *wc;
+  struct GNUNET_TIME_Absolute last_reported;
 
   /**
    * Collection point reporting task (or NULL)
@@ -239,6 +232,32 @@ struct CadetPeer
    */
   struct GNUNET_SCHEDULER_Task * reconnect_task;
 
+  /**
+   * Entries of the value batch we are collecting for this peer
+   */
+  char *batch;
+
+  /**
+   * Size of @e batch
+   */
+  size_t batch_size;
+
+  /**
+   * Number of entries in @e batch
+   */
+  unsigned int batch_count;
+
+  /**
+   * Task sending @e batch (or NULL)
+   */
+  struct GNUNET_SCHEDULER_Task *batch_task;
+
+  /**
+   * Did the collection point announce that it accepts reading batches?
+   * Until it does, we send every reading in its own message.
+   */
+  int batch_ok;
+
   /**
    * Are we currently destroying the channel and its context?
    */
@@ -337,6 +356,11 @@ static int neighborhood;
  */
 static long long unsigned int pow_matching_bits;
 
+/**
+ * Time to wait for more values before sending a batch to a collection point
+ */
+static struct GNUNET_TIME_Relative batch_delay;
+
 
 
 /**
@@ -395,21 +419,11 @@ destroy_anomaly_info (struct AnomalyInfo *ai)
 static void
 destroy_value_info (struct ValueInfo *vi)
 {
-  if (NULL != vi->wc)
-  {
-    GNUNET_PEERSTORE_watch_cancel (vi->wc);
-    vi->wc = NULL;
-  }
   if (NULL != vi->reporting_task)
   {
     GNUNET_SCHEDULER_cancel (vi->reporting_task);
     vi->reporting_task = NULL;
   }
-  if (NULL != vi->last_value)
-  {
-    GNUNET_free (vi->last_value);
-    vi->last_value = NULL;
-  }
   GNUNET_free (vi);
 }
 
@@ -468,6 +482,12 @@ destroy_cadet_peer (struct CadetPeer *cadetp)
     GNUNET_SCHEDULER_cancel (cadetp->reconnect_task);
     cadetp->reconnect_task = NULL;
   }
+  if (NULL != cadetp->batch_task)
+  {
+    GNUNET_SCHEDULER_cancel (cadetp->batch_task);
+    cadetp->batch_task = NULL;
+  }
+  GNUNET_free_non_null (cadetp->batch);
   if (NULL != cadetp->mq)
   {
     GNUNET_MQ_destroy (cadetp->mq);
@@ -627,6 +647,8 @@ cp_reconnect (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
        GNUNET_i2s (&cadetp->peer_id));
   cadetp->reconnect_task = NULL;
   GNUNET_assert (NULL == cadetp->channel);
+  /* the collection point may have changed, wait for its announcement */
+  cadetp->batch_ok = GNUNET_NO;
   cadetp->channel =
       GNUNET_CADET_channel_create (cadet, cadetp, &cadetp->peer_id,
                                    GNUNET_APPLICATION_TYPE_SENSORDASHBOARD,
@@ -902,28 +924,313 @@ update_anomaly_report_pow_block (struct AnomalyInfo *ai)
 
 
 /**
- * Create a sensor value message from a given value info struct inside a MQ
- * envelope.
+ * Context for collecting the readings of a sensor for a report.
+ */
+struct WindowContext
+{
+
+  /**
+   * Numeric readings (if the sensor is numeric)
+   */
+  double *values;
+
+  /**
+   * Number of readings seen
+   */
+  unsigned int count;
+
+  /**
+   * Timestamp of the first reading
+   */
+  struct GNUNET_TIME_Absolute first;
+
+  /**
+   * Timestamp of the last reading
+   */
+  struct GNUNET_TIME_Absolute last;
+
+  /**
+   * The last reading
+   */
+  const void *last_value;
+
+  /**
+   * Size of @e last_value
+   */
+  size_t last_value_size;
+
+};
+
+
+/**
+ * Collect a reading of the reporting window.
+ *
+ * @param cls a `struct WindowContext *`
+ * @param timestamp time the reading was taken
+ * @param value the reading
+ * @param value_size size of @a value
+ */
+static void
+collect_reading (void *cls,
+                 struct GNUNET_TIME_Absolute timestamp,
+                 const void *value,
+                 size_t value_size)
+{
+  struct WindowContext *wc = cls;
+
+  if (0 == wc->count)
+    wc->first = timestamp;
+  wc->last = timestamp;
+  wc->last_value = value;
+  wc->last_value_size = value_size;
+  if (NULL != wc->values)
+  {
+    if (sizeof (double) == value_size)
+      memcpy (&wc->values[wc->count], value, sizeof (double));
+    else
+    {
+      GNUNET_break (0);
+      wc->values[wc->count] = 0;
+    }
+  }
+  wc->count++;
+}
+
+
+/**
+ * Comparator for sorting readings.
+ *
+ * @param a pointer to first double
+ * @param b pointer to second double
+ * @return -1, 0 or 1
+ */
+static int
+cmp_double (const void *a,
+            const void *b)
+{
+  double da = *(const double *) a;
+  double db = *(const double *) b;
+
+  if (da < db)
+    return -1;
+  return (da > db) ? 1 : 0;
+}
+
+
+/**
+ * Summarize sorted numeric readings.
+ *
+ * @param values the readings, sorted
+ * @param count number of readings, at least one
+ * @param agg where to store the summary
+ */
+static void
+aggregate_readings (const double *values,
+                    unsigned int count,
+                    struct GNUNET_SENSOR_ValueAggregate *agg)
+{
+  double sum;
+  unsigned int i;
+
+  sum = 0;
+  for (i = 0; i < count; i++)
+    sum += values[i];
+  agg->min = values[0];
+  agg->max = values[count - 1];
+  agg->mean = sum / count;
+  agg->median = values[(count - 1) / 2];
+  agg->percentile90 = values[((count - 1) * 9) / 10];
+}
+
+
+/**
+ * Send the batch of values collected for a collection point.
+ *
+ * @param cls the `struct CadetPeer *`
+ * @param tc unused
+ */
+static void
+send_value_batch (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct CadetPeer *cadetp = cls;
+  struct GNUNET_SENSOR_ValueBatchMessage *bm;
+  struct GNUNET_MQ_Envelope *ev;
+  char *cbuf;
+  uLongf clen;
+
+  cadetp->batch_task = NULL;
+  if (0 == cadetp->batch_count)
+    return;
+  if (NULL == cadetp->channel)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Trying to send values to collection point but connection failed, discarding.\n");
+  }
+  else
+  {
+    clen = compressBound (cadetp->batch_size);
+    cbuf = GNUNET_malloc (clen);
+    if ( (Z_OK ==
+          compress2 ((Bytef *) cbuf, &clen, (const Bytef *) cadetp->batch,
+                     cadetp->batch_size, 9)) &&
+         (clen < cadetp->batch_size) )
+    {
+      ev = GNUNET_MQ_msg_extra (bm, clen,
+                                GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH);
+      bm->compressed = htons (GNUNET_YES);
+      memcpy (&bm[1], cbuf, clen);
+    }
+    else
+    {
+      /* compression did not help, send entries as they are */
+      ev = GNUNET_MQ_msg_extra (bm, cadetp->batch_size,
+                                GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH);
+      bm->compressed = htons (GNUNET_NO);
+      memcpy (&bm[1], cadetp->batch, cadetp->batch_size);
+    }
+    GNUNET_free (cbuf);
+    bm->num_entries = htons (cadetp->batch_count);
+    bm->entries_size = htonl (cadetp->batch_size);
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Sending %u sensor values (%u bytes) to collection point `%s'.\n",
+         cadetp->batch_count, (unsigned int) cadetp->batch_size,
+         GNUNET_i2s (&cadetp->peer_id));
+    GNUNET_MQ_send (cadetp->mq, ev);
+  }
+  GNUNET_free (cadetp->batch);
+  cadetp->batch = NULL;
+  cadetp->batch_size = 0;
+  cadetp->batch_count = 0;
+}
+
+
+/**
+ * Send the last reading of a sensor to a collection point that does not
+ * (yet) accept reading batches.
  *
- * @param vi Value info struct to use
- * @return Envelope with message
+ * @param cadetp collection point
+ * @param vi value info of the sensor
+ * @param wc readings of the reporting window
  */
-static struct GNUNET_MQ_Envelope *
-create_value_message (struct ValueInfo *vi)
+static void
+send_single_value (struct CadetPeer *cadetp,
+                   struct ValueInfo *vi,
+                   const struct WindowContext *wc)
 {
   struct GNUNET_SENSOR_ValueMessage *vm;
   struct GNUNET_MQ_Envelope *ev;
 
-  ev = GNUNET_MQ_msg_extra (vm, vi->last_value_size,
+  if (NULL == cadetp->channel)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Trying to send value to collection point but connection failed, discarding.\n");
+    return;
+  }
+  ev = GNUNET_MQ_msg_extra (vm, wc->last_value_size,
                             GNUNET_MESSAGE_TYPE_SENSOR_READING);
   GNUNET_CRYPTO_hash (vi->sensor->name, strlen (vi->sensor->name) + 1,
                       &vm->sensorname_hash);
   vm->sensorversion_major = htons (vi->sensor->version_major);
   vm->sensorversion_minor = htons (vi->sensor->version_minor);
-  vm->timestamp = vi->last_value_timestamp;
-  vm->value_size = htons (vi->last_value_size);
-  memcpy (&vm[1], vi->last_value, vi->last_value_size);
-  return ev;
+  vm->timestamp = wc->last;
+  vm->value_size = htons (wc->last_value_size);
+  memcpy (&vm[1], wc->last_value, wc->last_value_size);
+  GNUNET_MQ_send (cadetp->mq, ev);
+}
+
+
+/**
+ * Add the readings of a sensor over the last reporting interval to the batch
+ * of the collection point.  Numeric readings are summarized, for other
+ * sensors only the last reading is reported.  If the collection point did
+ * not announce batch support, the last reading is sent right away instead.
+ *
+ * @param cadetp collection point
+ * @param vi value info of the sensor
+ * @return #GNUNET_YES if there were readings to report
+ */
+static int
+add_value_entry (struct CadetPeer *cadetp,
+                 struct ValueInfo *vi)
+{
+  struct GNUNET_SENSOR_SensorInfo *sensor = vi->sensor;
+  struct GNUNET_SENSOR_ValueBatchEntry *entry;
+  struct GNUNET_SENSOR_ValueAggregate agg;
+  struct WindowContext wc;
+  unsigned int count;
+  const void *value;
+  size_t value_size;
+  size_t entry_size;
+  int aggregated;
+
+  count = SENSOR_timeseries_iterate (sensor, vi->last_reported, NULL, NULL);
+  if (0 == count)
+    return GNUNET_NO;
+  memset (&wc, 0, sizeof (wc));
+  if ( (GNUNET_YES == cadetp->batch_ok) &&
+       (0 == strcmp (sensor->expected_datatype, "numeric")) )
+    wc.values = GNUNET_new_array (count, double);
+  SENSOR_timeseries_iterate (sensor, vi->last_reported, &collect_reading, &wc);
+  GNUNET_assert (count == wc.count);
+  if (GNUNET_YES != cadetp->batch_ok)
+  {
+    send_single_value (cadetp, vi, &wc);
+    vi->last_reported = wc.last;
+    return GNUNET_YES;
+  }
+  if (NULL != wc.values)
+  {
+    qsort (wc.values, count, sizeof (double), &cmp_double);
+    aggregate_readings (wc.values, count, &agg);
+    value = &agg;
+    value_size = sizeof (agg);
+    aggregated = GNUNET_YES;
+  }
+  else
+  {
+    value = wc.last_value;
+    value_size = wc.last_value_size;
+    aggregated = GNUNET_NO;
+  }
+  entry_size = sizeof (struct GNUNET_SENSOR_ValueBatchEntry) + value_size;
+  if (entry_size > MAX_BATCH_SIZE)
+  {
+    GNUNET_break (0);
+    GNUNET_free_non_null (wc.values);
+    return GNUNET_NO;
+  }
+  if (cadetp->batch_size + entry_size > MAX_BATCH_SIZE)
+  {
+    /* batch is full, send what we have */
+    if (NULL != cadetp->batch_task)
+    {
+      GNUNET_SCHEDULER_cancel (cadetp->batch_task);
+      cadetp->batch_task = NULL;
+    }
+    send_value_batch (cadetp, NULL);
+  }
+  cadetp->batch = GNUNET_realloc (cadetp->batch,
+                                  cadetp->batch_size + entry_size);
+  entry = (struct GNUNET_SENSOR_ValueBatchEntry *)
+      &cadetp->batch[cadetp->batch_size];
+  GNUNET_CRYPTO_hash (sensor->name, strlen (sensor->name) + 1,
+                      &entry->sensorname_hash);
+  entry->sensorversion_major = htons (sensor->version_major);
+  entry->sensorversion_minor = htons (sensor->version_minor);
+  entry->window_start = GNUNET_TIME_absolute_hton (wc.first);
+  entry->window_end = GNUNET_TIME_absolute_hton (wc.last);
+  entry->num_readings = htonl (count);
+  entry->aggregated = htons (aggregated);
+  entry->value_size = htons (value_size);
+  memcpy (&entry[1], value, value_size);
+  cadetp->batch_size += entry_size;
+  cadetp->batch_count++;
+  vi->last_reported = wc.last;
+  GNUNET_free_non_null (wc.values);
+  if (NULL == cadetp->batch_task)
+    cadetp->batch_task =
+        GNUNET_SCHEDULER_add_delayed (batch_delay, &send_value_batch, cadetp);
+  return GNUNET_YES;
 }
 
 
@@ -1021,44 +1328,6 @@ handle_anomaly_report (void *cls, const struct GNUNET_PeerIdentity *other,
 }
 
 
-/******************************************************************************/
-/************************      PEERSTORE callbacks     ************************/
-/******************************************************************************/
-
-
-/**
- * Sensor value watch callback
- *
- * @param cls Closure, ValueInfo struct related to the sensor we are watching
- * @param record PEERSTORE new record, NULL if error
- * @param emsg Error message, NULL if no error
- * @return #GNUNET_YES to continue watching
- */
-static int
-value_watch_cb (void *cls,
-                const struct GNUNET_PEERSTORE_Record *record,
-                const char *emsg)
-{
-  struct ValueInfo *vi = cls;
-
-  if (NULL != emsg)
-  {
-    LOG (GNUNET_ERROR_TYPE_ERROR, _("PEERSTORE error: %s.\n"), emsg);
-    return GNUNET_YES;
-  }
-  if (NULL != vi->last_value)
-  {
-    GNUNET_free (vi->last_value);
-    vi->last_value_size = 0;
-  }
-  vi->last_value = GNUNET_memdup (record->value, record->value_size);
-  vi->last_value_size = record->value_size;
-  vi->last_value_timestamp = GNUNET_TIME_absolute_get ();
-  vi->last_value_reported = GNUNET_NO;
-  return GNUNET_YES;
-}
-
-
 /******************************************************************************/
 /**************************      CORE callbacks     ***************************/
 /******************************************************************************/
@@ -1166,6 +1435,31 @@ core_startup_cb (void *cls, const struct GNUNET_PeerIdentity *my_identity)
 /*************************      CADET callbacks     ***************************/
 /******************************************************************************/
 
+
+/**
+ * The collection point announced that it accepts reading batches.
+ *
+ * @param cls closure (unused)
+ * @param channel connection to the collection point
+ * @param channel_ctx the `struct CadetPeer *` of the collection point
+ * @param message the announcement
+ * @return #GNUNET_OK to keep the channel open
+ */
+static int
+handle_batch_supported (void *cls, struct GNUNET_CADET_Channel *channel,
+                        void **channel_ctx,
+                        const struct GNUNET_MessageHeader *message)
+{
+  struct CadetPeer *cadetp = *channel_ctx;
+
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Collection point `%s' accepts reading batches.\n",
+       GNUNET_i2s (&cadetp->peer_id));
+  cadetp->batch_ok = GNUNET_YES;
+  GNUNET_CADET_receive_done (channel);
+  return GNUNET_OK;
+}
+
 /**
  * Function called whenever a channel is destroyed.  Should clean up
  * any associated state.
@@ -1256,7 +1550,7 @@ SENSOR_reporting_anomaly_update (struct GNUNET_SENSOR_SensorInfo *sensor,
 /**
  * Task scheduled to send values to collection point
  *
- * @param cls closure, a `struct ValueReportingContext *`
+ * @param cls closure, a `struct ValueInfo *`
  * @param tc unused
  */
 static void
@@ -1265,30 +1559,17 @@ report_value (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   struct ValueInfo *vi = cls;
   struct GNUNET_SENSOR_SensorInfo *sensor = vi->sensor;
   struct CadetPeer *cadetp;
-  struct GNUNET_MQ_Envelope *ev;
 
   vi->reporting_task =
       GNUNET_SCHEDULER_add_delayed (sensor->value_reporting_interval,
                                     &report_value, vi);
-  if (0 == vi->last_value_size || GNUNET_YES == vi->last_value_reported)
-  {
-    LOG (GNUNET_ERROR_TYPE_WARNING,
-         "Did not receive a fresh value from `%s' to report.\n", sensor->name);
-    return;
-  }
   LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Now trying to report last seen value of `%s' to collection point.\n",
+       "Now trying to report values of `%s' to collection point.\n",
        sensor->name);
   cadetp = get_cadet_peer (*sensor->collection_point);
-  if (NULL == cadetp->channel)
-  {
+  if (GNUNET_NO == add_value_entry (cadetp, vi))
     LOG (GNUNET_ERROR_TYPE_WARNING,
-         "Trying to send value to collection point but connection failed, discarding.\n");
-    return;
-  }
-  ev = create_value_message (vi);
-  GNUNET_MQ_send (cadetp->mq, ev);
-  vi->last_value_reported = GNUNET_YES;
+         "Did not receive a fresh value from `%s' to report.\n", sensor->name);
 }
 
 
@@ -1333,12 +1614,7 @@ init_sensor_reporting (void *cls, const struct GNUNET_HashCode *key,
                                                GNUNET_YES));
   vi = GNUNET_new (struct ValueInfo);
   vi->sensor = sensor;
-  vi->last_value = NULL;
-  vi->last_value_size = 0;
-  vi->last_value_reported = GNUNET_NO;
-  vi->wc =
-      GNUNET_PEERSTORE_watch (peerstore, "sensor", &mypeerid, sensor->name,
-                              &value_watch_cb, vi);
+  vi->last_reported = GNUNET_TIME_UNIT_ZERO_ABS;
   vi->reporting_task =
       GNUNET_SCHEDULER_add_delayed (sensor->value_reporting_interval,
                                     &report_value, vi);
@@ -1366,6 +1642,9 @@ SENSOR_reporting_start (const struct GNUNET_CONFIGURATION_Handle *c,
     {NULL, 0, 0}
   };
   static struct GNUNET_CADET_MessageHandler cadet_handlers[] = {
+    {&handle_batch_supported,
+     GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH_SUPPORTED,
+     sizeof (struct GNUNET_MessageHeader)},
     {NULL, 0, 0}
   };
 
@@ -1383,6 +1662,10 @@ SENSOR_reporting_start (const struct GNUNET_CONFIGURATION_Handle *c,
     SENSOR_reporting_stop ();
     return GNUNET_SYSERR;
   }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg, "sensor-reporting",
+                                           "BATCH_DELAY", &batch_delay))
+    batch_delay = DEFAULT_BATCH_DELAY;
   if (pow_matching_bits > sizeof (struct GNUNET_HashCode))
   {
     LOG (GNUNET_ERROR_TYPE_ERROR, "Matching bits value too large (%d > %d).\n",
@@ -0,0 +1,275 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file sensor/gnunet-service-sensor_timeseries.c
+ * @brief in-memory time series of recent sensor readings, shared by the
+ *        monitoring (writer) and reporting (reader) modules
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "sensor.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "sensor-timeseries",__VA_ARGS__)
+
+/**
+ * Default number of readings we keep per sensor.
+ */
+#define DEFAULT_TIMESERIES_LENGTH 64
+
+
+/**
+ * A single sensor reading.
+ */
+struct Reading
+{
+
+  /**
+   * Time the reading was taken
+   */
+  struct GNUNET_TIME_Absolute timestamp;
+
+  /**
+   * The reading, NULL for an unused slot
+   */
+  void *value;
+
+  /**
+   * Size of @e value
+   */
+  size_t value_size;
+
+};
+
+
+/**
+ * Ring buffer with the most recent readings of a sensor.
+ */
+struct TimeSeries
+{
+
+  /**
+   * Array of #timeseries_length readings
+   */
+  struct Reading *readings;
+
+  /**
+   * Index of the slot the next reading goes to (the oldest reading if
+   * the ring is full)
+   */
+  unsigned int next;
+
+  /**
+   * Number of readings in the ring
+   */
+  unsigned int count;
+
+};
+
+
+/**
+ * Time series of all sensors, by hash of the sensor name.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *series;
+
+/**
+ * Number of readings we keep per sensor.
+ */
+static unsigned long long timeseries_length;
+
+
+/**
+ * Free a time series.
+ *
+ * @param cls unused
+ * @param key unused
+ * @param value the `struct TimeSeries *` to free
+ * @return #GNUNET_YES to continue iterations
+ */
+static int
+destroy_timeseries (void *cls,
+                    const struct GNUNET_HashCode *key,
+                    void *value)
+{
+  struct TimeSeries *ts = value;
+  unsigned int i;
+
+  for (i = 0; i < timeseries_length; i++)
+    GNUNET_free_non_null (ts->readings[i].value);
+  GNUNET_free (ts->readings);
+  GNUNET_free (ts);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Stop the sensor time series module
+ */
+void
+SENSOR_timeseries_stop ()
+{
+  if (NULL != series)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (series, &destroy_timeseries, NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (series);
+    series = NULL;
+  }
+}
+
+
+/**
+ * Create an empty time series for a sensor.
+ *
+ * @param cls unused
+ * @param key hash of the sensor name
+ * @param value a `struct GNUNET_SENSOR_SensorInfo *`
+ * @return #GNUNET_YES to continue iterations
+ */
+static int
+create_timeseries (void *cls,
+                   const struct GNUNET_HashCode *key,
+                   void *value)
+{
+  struct TimeSeries *ts;
+
+  ts = GNUNET_new (struct TimeSeries);
+  ts->readings = GNUNET_new_array (timeseries_length, struct Reading);
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_CONTAINER_multihashmap_put (series, key, ts,
+                                                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return GNUNET_YES;
+}
+
+
+/**
+ * Start the sensor time series module, keeping the most recent readings of
+ * each sensor in memory for the other modules.
+ *
+ * @param c our service configuration
+ * @param s multihashmap of loaded sensors
+ * @return #GNUNET_OK if started successfully, #GNUNET_SYSERR otherwise
+ */
+int
+SENSOR_timeseries_start (const struct GNUNET_CONFIGURATION_Handle *c,
+                         struct GNUNET_CONTAINER_MultiHashMap *s)
+{
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "Starting sensor time series module.\n");
+  GNUNET_assert (NULL != s);
+  if ( (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (c, "sensor",
+                                               "TIMESERIES_LENGTH",
+                                               &timeseries_length)) ||
+       (0 == timeseries_length) )
+    timeseries_length = DEFAULT_TIMESERIES_LENGTH;
+  series =
+      GNUNET_CONTAINER_multihashmap_create (GNUNET_CONTAINER_multihashmap_size
+                                            (s) + 1, GNUNET_NO);
+  GNUNET_CONTAINER_multihashmap_iterate (s, &create_timeseries, NULL);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Find the time series of a sensor.
+ *
+ * @param sensor the sensor
+ * @return NULL if the module is not running or the sensor is unknown
+ */
+static struct TimeSeries *
+get_timeseries (struct GNUNET_SENSOR_SensorInfo *sensor)
+{
+  struct GNUNET_HashCode key;
+
+  if (NULL == series)
+    return NULL;
+  GNUNET_CRYPTO_hash (sensor->name, strlen (sensor->name) + 1, &key);
+  return GNUNET_CONTAINER_multihashmap_get (series, &key);
+}
+
+
+/**
+ * Record a new reading of a sensor, replacing the oldest one if the time
+ * series of the sensor is full.
+ *
+ * @param sensor sensor the reading belongs to
+ * @param value the reading
+ * @param value_size size of @a value
+ */
+void
+SENSOR_timeseries_add (struct GNUNET_SENSOR_SensorInfo *sensor,
+                       const void *value,
+                       size_t value_size)
+{
+  struct TimeSeries *ts;
+  struct Reading *r;
+
+  ts = get_timeseries (sensor);
+  if (NULL == ts)
+    return;
+  r = &ts->readings[ts->next];
+  GNUNET_free_non_null (r->value);
+  r->value = GNUNET_memdup (value, value_size);
+  r->value_size = value_size;
+  r->timestamp = GNUNET_TIME_absolute_get ();
+  ts->next = (ts->next + 1) % timeseries_length;
+  if (ts->count < timeseries_length)
+    ts->count++;
+}
+
+
+/**
+ * Iterate over the readings of a sensor taken after @a since, oldest first.
+ *
+ * @param sensor sensor to iterate over
+ * @param since only readings strictly newer than this are returned
+ * @param it function to call on each reading, can be NULL to just count
+ * @param it_cls closure for @a it
+ * @return number of readings @a it was called with
+ */
+unsigned int
+SENSOR_timeseries_iterate (struct GNUNET_SENSOR_SensorInfo *sensor,
+                           struct GNUNET_TIME_Absolute since,
+                           SENSOR_TimeSeriesIterator it,
+                           void *it_cls)
+{
+  struct TimeSeries *ts;
+  struct Reading *r;
+  unsigned int i;
+  unsigned int ret;
+
+  ts = get_timeseries (sensor);
+  if (NULL == ts)
+    return 0;
+  ret = 0;
+  for (i = 0; i < ts->count; i++)
+  {
+    r = &ts->readings[(ts->next + timeseries_length - ts->count + i) %
+                      timeseries_length];
+    if (r->timestamp.abs_value_us <= since.abs_value_us)
+      continue;
+    if (NULL != it)
+      it (it_cls, r->timestamp, r->value, r->value_size);
+    ret++;
+  }
+  return ret;
+}
+
+/* end of gnunet-service-sensor_timeseries.c */
@@ -170,3 +170,68 @@ SENSOR_monitoring_stop ();
 int
 SENSOR_monitoring_start (const struct GNUNET_CONFIGURATION_Handle *c,
                          struct GNUNET_CONTAINER_MultiHashMap *s);
+
+
+/**
+ * Function called with the readings of a sensor kept in the time series.
+ *
+ * @param cls closure
+ * @param timestamp time the reading was taken
+ * @param value the reading
+ * @param value_size size of @a value
+ */
+typedef void
+(*SENSOR_TimeSeriesIterator) (void *cls,
+                              struct GNUNET_TIME_Absolute timestamp,
+                              const void *value,
+                              size_t value_size);
+
+
+/**
+ * Stop the sensor time series module
+ */
+void
+SENSOR_timeseries_stop ();
+
+
+/**
+ * Start the sensor time series module, keeping the most recent readings of
+ * each sensor in memory for the other modules.
+ *
+ * @param c our service configuration
+ * @param s multihashmap of loaded sensors
+ * @return #GNUNET_OK if started successfully, #GNUNET_SYSERR otherwise
+ */
+int
+SENSOR_timeseries_start (const struct GNUNET_CONFIGURATION_Handle *c,
+                         struct GNUNET_CONTAINER_MultiHashMap *s);
+
+
+/**
+ * Record a new reading of a sensor, replacing the oldest one if the time
+ * series of the sensor is full.
+ *
+ * @param sensor sensor the reading belongs to
+ * @param value the reading
+ * @param value_size size of @a value
+ */
+void
+SENSOR_timeseries_add (struct GNUNET_SENSOR_SensorInfo *sensor,
+                       const void *value,
+                       size_t value_size);
+
+
+/**
+ * Iterate over the readings of a sensor taken after @a since, oldest first.
+ *
+ * @param sensor sensor to iterate over
+ * @param since only readings strictly newer than this are returned
+ * @param it function to call on each reading, can be NULL to just count
+ * @param it_cls closure for @a it
+ * @return number of readings @a it was called with
+ */
+unsigned int
+SENSOR_timeseries_iterate (struct GNUNET_SENSOR_SensorInfo *sensor,
+                           struct GNUNET_TIME_Absolute since,
+                           SENSOR_TimeSeriesIterator it,
+                           void *it_cls);
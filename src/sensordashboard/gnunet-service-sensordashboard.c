@@ -31,6 +31,7 @@
 #include "gnunet_cadet_service.h"
 #include "gnunet_sensor_util_lib.h"
 #include "gnunet_peerstore_service.h"
+#include <zlib.h>
 
 
 /**
@@ -159,6 +160,12 @@ static struct GNUNET_PEERSTORE_Handle *peerstore;
  */
 static char *values_subsystem = "sensordashboard-values";
 
+/**
+ * Name of the subsystem used to store summaries of numeric sensor readings
+ * (`struct GNUNET_SENSOR_ValueAggregate`) received from peers
+ */
+static char *aggregates_subsystem = "sensordashboard-aggregates";
+
 /**
  * Name of the subsystem used to store anomaly reports received from remote
  * peers in PEERSTORE
@@ -286,6 +293,16 @@ cadet_channel_destroyed (void *cls, const struct GNUNET_CADET_Channel *channel,
 }
 
 
+/**
+ * Add a new message to the queue to be sent to the given client peer.
+ *
+ * @param msg Message to be queued
+ * @param cp Client peer context
+ */
+static void
+queue_msg (struct GNUNET_MessageHeader *msg, struct ClientPeerContext *cp);
+
+
 /**
  * Method called whenever another peer has added us to a channel
  * the other peer initiated.
@@ -310,6 +327,7 @@ cadet_channel_created (void *cls, struct GNUNET_CADET_Channel *channel,
                        uint32_t port, enum GNUNET_CADET_ChannelOption options)
 {
   struct ClientPeerContext *cp;
+  struct GNUNET_MessageHeader *msg;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received a channel connection from peer `%s'.\n",
@@ -320,6 +338,16 @@ cadet_channel_created (void *cls, struct GNUNET_CADET_Channel *channel,
   cp->ch = channel;
   cp->destroying = GNUNET_NO;
   GNUNET_CONTAINER_DLL_insert (cp_head, cp_tail, cp);
+  if (GNUNET_APPLICATION_TYPE_SENSORDASHBOARD == port)
+  {
+    /* tell the reporting peer it may send reading batches; peers that
+       do not know this message never get anything else from us on
+       this channel, so it does not matter if they do not process it */
+    msg = GNUNET_new (struct GNUNET_MessageHeader);
+    msg->size = htons (sizeof (struct GNUNET_MessageHeader));
+    msg->type = htons (GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH_SUPPORTED);
+    queue_msg (msg, cp);
+  }
   return cp;
 }
 
@@ -648,6 +676,174 @@ handle_sensor_reading (void *cls, struct GNUNET_CADET_Channel *channel,
 }
 
 
+/**
+ * Store one entry of a sensor reading batch.
+ *
+ * @param cp peer that sent the batch
+ * @param entry the entry, followed by its value
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the entry is malformed
+ */
+static int
+store_batch_entry (struct ClientPeerContext *cp,
+                   const struct GNUNET_SENSOR_ValueBatchEntry *entry)
+{
+  struct GNUNET_SENSOR_SensorInfo *sensor;
+  const struct GNUNET_SENSOR_ValueAggregate *agg;
+  uint16_t value_size;
+  int numeric;
+
+  value_size = ntohs (entry->value_size);
+  sensor = GNUNET_CONTAINER_multihashmap_get (sensors, &entry->sensorname_hash);
+  if (NULL == sensor)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Unknown sensor name in reading batch.\n");
+    return GNUNET_OK;
+  }
+  if ((sensor->version_minor != ntohs (entry->sensorversion_minor)) ||
+      (sensor->version_major != ntohs (entry->sensorversion_major)))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Sensor version mismatch in reading batch.\n");
+    return GNUNET_OK;
+  }
+  numeric = (0 == strcmp (sensor->expected_datatype, "numeric"));
+  if (GNUNET_YES == ntohs (entry->aggregated))
+  {
+    if ( (! numeric) ||
+         (sizeof (struct GNUNET_SENSOR_ValueAggregate) != value_size) )
+    {
+      GNUNET_break_op (0);
+      return GNUNET_SYSERR;
+    }
+    agg = (const struct GNUNET_SENSOR_ValueAggregate *) &entry[1];
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Received %u readings of sensor `%s' from peer `%s'.\n",
+                (unsigned int) ntohl (entry->num_readings), sensor->name,
+                GNUNET_i2s (&cp->peerid));
+    /* the mean goes where single readings go, for existing consumers */
+    GNUNET_PEERSTORE_store (peerstore, values_subsystem, &cp->peerid,
+                            sensor->name, &agg->mean, sizeof (double),
+                            GNUNET_TIME_UNIT_FOREVER_ABS,
+                            GNUNET_PEERSTORE_STOREOPTION_MULTIPLE, NULL, NULL);
+    GNUNET_PEERSTORE_store (peerstore, aggregates_subsystem, &cp->peerid,
+                            sensor->name, agg, value_size,
+                            GNUNET_TIME_UNIT_FOREVER_ABS,
+                            GNUNET_PEERSTORE_STOREOPTION_MULTIPLE, NULL, NULL);
+    return GNUNET_OK;
+  }
+  if (numeric && (sizeof (double) != value_size))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_PEERSTORE_store (peerstore, values_subsystem, &cp->peerid,
+                          sensor->name, &entry[1], value_size,
+                          GNUNET_TIME_UNIT_FOREVER_ABS,
+                          GNUNET_PEERSTORE_STOREOPTION_MULTIPLE, NULL, NULL);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Called with batches of sensor readings received from CADET.
+ *
+ * @param cls Closure (set from #GNUNET_CADET_connect).
+ * @param channel Connection to the other end.
+ * @param channel_ctx Place to store local state associated with the channel.
+ * @param message The actual message.
+ * @return #GNUNET_OK to keep the channel open,
+ *         #GNUNET_SYSERR to close it (signal serious error).
+ */
+static int
+handle_sensor_reading_batch (void *cls, struct GNUNET_CADET_Channel *channel,
+                             void **channel_ctx,
+                             const struct GNUNET_MessageHeader *message)
+{
+  struct ClientPeerContext *cp = *channel_ctx;
+  const struct GNUNET_SENSOR_ValueBatchMessage *bm;
+  const struct GNUNET_SENSOR_ValueBatchEntry *entry;
+  const char *entries;
+  char *buf;
+  uLongf dlen;
+  size_t size;
+  size_t entries_size;
+  size_t off;
+  uint16_t num_entries;
+  uint16_t i;
+  int ret;
+
+  if (ntohs (message->size) < sizeof (struct GNUNET_SENSOR_ValueBatchMessage))
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  bm = (const struct GNUNET_SENSOR_ValueBatchMessage *) message;
+  size = ntohs (message->size) - sizeof (struct GNUNET_SENSOR_ValueBatchMessage);
+  entries_size = ntohl (bm->entries_size);
+  num_entries = ntohs (bm->num_entries);
+  if (entries_size > GNUNET_SERVER_MAX_MESSAGE_SIZE)
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  buf = NULL;
+  entries = (const char *) &bm[1];
+  if (GNUNET_YES == ntohs (bm->compressed))
+  {
+    buf = GNUNET_malloc (entries_size);
+    dlen = entries_size;
+    if ((Z_OK !=
+         uncompress ((Bytef *) buf, &dlen, (const Bytef *) &bm[1],
+                     (uLong) size)) || (dlen != entries_size))
+    {
+      GNUNET_break_op (0);
+      GNUNET_free (buf);
+      return GNUNET_SYSERR;
+    }
+    entries = buf;
+  }
+  else if (size != entries_size)
+  {
+    GNUNET_break_op (0);
+    return GNUNET_SYSERR;
+  }
+  ret = GNUNET_OK;
+  off = 0;
+  for (i = 0; (i < num_entries) && (GNUNET_OK == ret); i++)
+  {
+    entry = (const struct GNUNET_SENSOR_ValueBatchEntry *) &entries[off];
+    if ( (entries_size - off < sizeof (struct GNUNET_SENSOR_ValueBatchEntry)) ||
+         (entries_size - off - sizeof (struct GNUNET_SENSOR_ValueBatchEntry) <
+          ntohs (entry->value_size)) )
+    {
+      GNUNET_break_op (0);
+      ret = GNUNET_SYSERR;
+      break;
+    }
+    ret = store_batch_entry (cp, entry);
+    off += sizeof (struct GNUNET_SENSOR_ValueBatchEntry) +
+        ntohs (entry->value_size);
+  }
+  if ( (GNUNET_OK == ret) &&
+       (off != entries_size) )
+  {
+    GNUNET_break_op (0);
+    ret = GNUNET_SYSERR;
+  }
+  GNUNET_free_non_null (buf);
+  if (GNUNET_OK != ret)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Received an invalid sensor reading batch from peer `%s'.\n",
+                GNUNET_i2s (&cp->peerid));
+    return GNUNET_SYSERR;
+  }
+  GNUNET_CADET_receive_done (channel);
+  return GNUNET_OK;
+}
+
+
 /**
  * Create a message with full information about sensor
  *
@@ -809,6 +1005,8 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
   static struct GNUNET_CADET_MessageHandler cadet_handlers[] = {
     {&handle_sensor_reading,
      GNUNET_MESSAGE_TYPE_SENSOR_READING, 0},
+    {&handle_sensor_reading_batch,
+     GNUNET_MESSAGE_TYPE_SENSOR_READING_BATCH, 0},
     {&handle_sensor_list_req,
      GNUNET_MESSAGE_TYPE_SENSOR_LIST_REQ,
      sizeof (struct GNUNET_MessageHeader)},
@@ -93,6 +93,11 @@ static const struct GNUNET_CONFIGURATION_Handle *configuration;
  */
 static struct GNUNET_CADET_Handle *cadet;
 
+/**
+ * Statistics handle.
+ */
+struct GNUNET_STATISTICS_Handle *_GSS_statistics;
+
 /**
  * Sets are held in a doubly linked list.
  */
@@ -423,6 +428,18 @@ _GSS_operation_destroy (struct Operation *op,
                                op);
   op->vt->cancel (op);
   op->vt = NULL;
+#if HAVE_GETRUSAGE
+  {
+    struct rusage ru;
+
+    /* the operation is finished, so this covers its peak footprint */
+    if (0 == getrusage (RUSAGE_SELF, &ru))
+      GNUNET_STATISTICS_set (_GSS_statistics,
+                             "# peak resident set size (KiB)",
+                             ru.ru_maxrss,
+                             GNUNET_NO);
+  }
+#endif
   if (NULL != op->spec)
   {
     if (NULL != op->spec->context_msg)
@@ -1681,6 +1698,12 @@ shutdown_task (void *cls,
     GNUNET_CADET_disconnect (cadet);
     cadet = NULL;
   }
+  if (NULL != _GSS_statistics)
+  {
+    GNUNET_STATISTICS_destroy (_GSS_statistics,
+                               GNUNET_YES);
+    _GSS_statistics = NULL;
+  }
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "handled shutdown request\n");
 }
@@ -1862,6 +1885,20 @@ dispatch_p2p_message (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Dispatching cadet message (type: %u)\n",
               ntohs (message->type));
+  /* Operations we evaluated ourselves were never suggested to a
+   * listener; account the traffic separately for both sides. */
+  GNUNET_STATISTICS_update (_GSS_statistics,
+                            (0 == op->suggest_id)
+                            ? "# p2p bytes received by initiator"
+                            : "# p2p bytes received by acceptor",
+                            ntohs (message->size),
+                            GNUNET_NO);
+  GNUNET_STATISTICS_update (_GSS_statistics,
+                            (0 == op->suggest_id)
+                            ? "# p2p messages received by initiator"
+                            : "# p2p messages received by acceptor",
+                            1,
+                            GNUNET_NO);
   /* do this before the handler, as the handler might kill the channel */
   GNUNET_CADET_receive_done (channel);
   if (NULL != op->vt)
@@ -1931,18 +1968,21 @@ run (void *cls,
   static const struct GNUNET_CADET_MessageHandler cadet_handlers[] = {
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_P2P_OPERATION_REQUEST, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF, 0},
+    { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF_MORE, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_P2P_ELEMENTS, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_UNION_P2P_DONE, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_P2P_ELEMENT_REQUESTS, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_UNION_P2P_SE, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_ELEMENT_INFO, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_BF, 0},
+    { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER, 0},
     { &dispatch_p2p_message, GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_DONE, 0},
     {NULL, 0, 0}
   };
   static const uint32_t cadet_ports[] = {GNUNET_APPLICATION_TYPE_SET, 0};
 
   configuration = cfg;
+  _GSS_statistics = GNUNET_STATISTICS_create ("set", cfg);
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
                                 &shutdown_task, NULL);
   GNUNET_SERVER_disconnect_notify (server,
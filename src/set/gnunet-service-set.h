@@ -32,6 +32,7 @@
 #include "gnunet_applications.h"
 #include "gnunet_core_service.h"
 #include "gnunet_cadet_service.h"
+#include "gnunet_statistics_service.h"
 #include "gnunet_set_service.h"
 #include "set.h"
 
@@ -578,6 +579,13 @@ struct Set
 };
 
 
+/**
+ * Statistics handle of the set service, used by the operation
+ * implementations to report per-operation counters.
+ */
+extern struct GNUNET_STATISTICS_Handle *_GSS_statistics;
+
+
 /**
  * Destroy the given operation.  Call the implementation-specific
  * cancel function of the operation.  Disconnects from the remote
@@ -29,6 +29,27 @@
 #include "gnunet_block_lib.h"
 #include "gnunet-service-set_protocol.h"
 #include <gcrypt.h>
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+
+/**
+ * Below how many elements do we build and apply filters
+ * in the main thread only?
+ */
+#define FILTER_THREAD_THRESHOLD (64 * 1024)
+
+/**
+ * Maximum number of threads (including the main thread) used
+ * for building and applying filters.
+ */
+#define FILTER_MAX_THREADS 8
+
+/**
+ * Maximum number of remainder bits of a Golomb-compressed set.
+ */
+#define GCS_MAX_BITS 32
 
 
 /**
@@ -73,9 +94,20 @@ struct OperationState
   struct GNUNET_CONTAINER_BloomFilter *remote_bf;
 
   /**
-   * BF of the set's element.
+   * Sorted values of the Golomb-compressed set we currently
+   * receive (instead of @e remote_bf), @e remote_gcs_len entries.
    */
-  struct GNUNET_CONTAINER_BloomFilter *local_bf;
+  uint64_t *remote_gcs;
+
+  /**
+   * Number of values in @e remote_gcs.
+   */
+  uint32_t remote_gcs_len;
+
+  /**
+   * Range of the values in @e remote_gcs.
+   */
+  uint64_t remote_gcs_range;
 
   /**
    * Remaining elements in the intersection operation.
@@ -139,12 +171,24 @@ struct OperationState
    */
   uint32_t bf_bits_per_element;
 
+  /**
+   * Encoding of the filter in @e bf_data, a
+   * `enum IntersectionFilterEncoding`.
+   */
+  uint32_t bf_encoding;
+
   /**
    * Salt currently used for BF construction (by us or the other peer,
    * depending on where we are in the code).
    */
   uint32_t salt;
 
+  /**
+   * Does the other peer understand
+   * #GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER messages?
+   */
+  int remote_filter_ok;
+
   /**
    * Current state of the operation.
    */
@@ -217,29 +261,499 @@ send_client_removed_element (struct Operation *op,
 
 
 /**
- * Fills the "my_elements" hashmap with all relevant elements.
+ * Share of the work of building or applying a filter,
+ * done by one thread.
+ */
+struct FilterShare
+{
+  /**
+   * Elements to process.
+   */
+  struct ElementEntry **elements;
+
+  /**
+   * Hash of the salt, mingled into the element hashes.
+   */
+  struct GNUNET_HashCode salt_hash;
+
+  /**
+   * Bloom filter to test against, or to add to.
+   */
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+
+  /**
+   * Sorted GCS values to test against, NULL if we use @e bf.
+   */
+  const uint64_t *gcs;
+
+  /**
+   * Number of entries in @e gcs.
+   */
+  uint32_t gcs_len;
+
+  /**
+   * Range of GCS values.
+   */
+  uint64_t gcs_range;
+
+  /**
+   * When testing, set to 1 for elements passing the filter, 0 otherwise.
+   * Indexed like @e elements.
+   */
+  char *keep;
+
+  /**
+   * GCS values of the elements, when building a GCS.
+   */
+  uint64_t *values;
+
+  /**
+   * First element of the share.
+   */
+  unsigned int start;
+
+  /**
+   * One after the last element of the share.
+   */
+  unsigned int end;
+};
+
+
+/**
+ * Closure for #collect_elements_iterator().
+ */
+struct ElementCollector
+{
+  /**
+   * Array to collect the elements in.
+   */
+  struct ElementEntry **elements;
+
+  /**
+   * Operation to filter the elements by generation, or NULL.
+   */
+  struct Operation *op;
+
+  /**
+   * Number of elements collected.
+   */
+  unsigned int n;
+
+  /**
+   * Allocated length of @e elements.
+   */
+  unsigned int size;
+};
+
+
+/**
+ * Mingle an element hash with the hash of the salt.  Same as
+ * #GNUNET_BLOCK_mingle_hash(), but the salt is only hashed once
+ * for all elements.
  *
- * @param cls the `struct Operation *` we are performing
- * @param key current key code
- * @param value the `struct ElementEntry *` from the hash map
- * @return #GNUNET_YES (we should continue to iterate)
+ * @param element_hash hash of the element
+ * @param salt_hash hash of the salt
+ * @param[out] mutated_hash set to the mingled hash
+ */
+static void
+mingle_hash (const struct GNUNET_HashCode *element_hash,
+             const struct GNUNET_HashCode *salt_hash,
+             struct GNUNET_HashCode *mutated_hash)
+{
+  GNUNET_CRYPTO_hash_xor (salt_hash,
+                          element_hash,
+                          mutated_hash);
+}
+
+
+/**
+ * Compute the value of a (mingled) hash in a Golomb-compressed set.
+ *
+ * @param mutated_hash the mingled hash
+ * @param range number of elements times 2^bits
+ * @return the value, smaller than @a range
+ */
+static uint64_t
+gcs_value (const struct GNUNET_HashCode *mutated_hash,
+           uint64_t range)
+{
+  uint64_t v;
+
+  memcpy (&v, mutated_hash, sizeof (v));
+  return GNUNET_ntohll (v) % range;
+}
+
+
+/**
+ * Test if a value is in a Golomb-compressed set.
+ *
+ * @param gcs sorted values of the set
+ * @param len number of values
+ * @param v value to look for
+ * @return #GNUNET_YES if @a v is in the set
  */
 static int
-filtered_map_initialization (void *cls,
-                             const struct GNUNET_HashCode *key,
-                             void *value)
+gcs_contains (const uint64_t *gcs,
+              uint32_t len,
+              uint64_t v)
 {
-  struct Operation *op = cls;
-  struct ElementEntry *ee = value;
+  uint32_t lo = 0;
+  uint32_t hi = len;
+
+  while (lo < hi)
+  {
+    uint32_t mid = lo + (hi - lo) / 2;
+
+    if (gcs[mid] < v)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return ( (lo < len) && (gcs[lo] == v) ) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Compare two GCS values, for qsort().
+ *
+ * @param a first value
+ * @param b second value
+ * @return -1, 0 or 1
+ */
+static int
+gcs_value_cmp (const void *a,
+               const void *b)
+{
+  uint64_t va = *(const uint64_t *) a;
+  uint64_t vb = *(const uint64_t *) b;
+
+  if (va < vb)
+    return -1;
+  return (va > vb) ? 1 : 0;
+}
+
+
+/**
+ * Encode sorted values as Golomb-compressed set.
+ *
+ * @param values the sorted values
+ * @param n number of @a values
+ * @param bits number of remainder bits
+ * @param[out] size set to the size of the result
+ * @return the encoded set
+ */
+static char *
+gcs_encode (const uint64_t *values,
+            uint32_t n,
+            unsigned int bits,
+            uint32_t *size)
+{
+  unsigned char *buf;
+  uint64_t prev;
+  uint64_t pos;
+  uint64_t max;
+  uint32_t i;
+  unsigned int j;
+
+  /* quotients sum up to at most the range >> bits == n */
+  max = ((uint64_t) n * (bits + 2) + 7) / 8;
+  buf = GNUNET_malloc_large (max);
+  GNUNET_assert (NULL != buf);
+  memset (buf, 0, max);
+  pos = 0;
+  prev = 0;
+  for (i = 0; i < n; i++)
+  {
+    uint64_t delta = values[i] - prev;
+    uint64_t q = delta >> bits;
+
+    prev = values[i];
+    for (; q > 0; q--, pos++)
+      buf[pos / 8] |= 0x80 >> (pos % 8);
+    pos++; /* terminating zero */
+    for (j = bits; j > 0; j--, pos++)
+      if (0 != (delta & (1LLU << (j - 1))))
+        buf[pos / 8] |= 0x80 >> (pos % 8);
+  }
+  GNUNET_assert (pos <= max * 8);
+  *size = (uint32_t) ((pos + 7) / 8);
+  return (char *) buf;
+}
+
+
+/**
+ * Decode a Golomb-compressed set.
+ *
+ * @param data the encoded set
+ * @param size number of bytes in @a data
+ * @param n number of values in the set
+ * @param bits number of remainder bits
+ * @param[out] values set to the sorted values
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a data is malformed
+ */
+static int
+gcs_decode (const char *data,
+            uint32_t size,
+            uint32_t n,
+            unsigned int bits,
+            uint64_t **values)
+{
+  const unsigned char *buf = (const unsigned char *) data;
+  uint64_t total = (uint64_t) size * 8;
+  uint64_t range = ((uint64_t) n) << bits;
+  uint64_t pos;
+  uint64_t v;
+  uint32_t i;
+  unsigned int j;
+
+  /* every value needs at least bits + 1 bits */
+  if ( (0 == n) ||
+       ((uint64_t) n * (bits + 1) > total) )
+    return GNUNET_SYSERR;
+  *values = GNUNET_malloc_large (n * sizeof (uint64_t));
+  if (NULL == *values)
+    return GNUNET_SYSERR;
+  pos = 0;
+  v = 0;
+  for (i = 0; i < n; i++)
+  {
+    uint64_t q = 0;
+    uint64_t r = 0;
+
+    while ( (pos < total) &&
+            (0 != (buf[pos / 8] & (0x80 >> (pos % 8)))) )
+    {
+      q++;
+      pos++;
+    }
+    pos++; /* terminating zero */
+    if (pos + bits > total)
+      break;
+    for (j = 0; j < bits; j++, pos++)
+      r = (r << 1) | ((buf[pos / 8] >> (7 - pos % 8)) & 1);
+    v += (q << bits) | r;
+    if (v >= range)
+      break;
+    (*values)[i] = v;
+  }
+  if (i < n)
+  {
+    GNUNET_free (*values);
+    *values = NULL;
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Test the elements of a share against the remote filter.
+ *
+ * @param cls the `struct FilterShare`
+ * @return NULL
+ */
+static void *
+test_share (void *cls)
+{
+  struct FilterShare *fs = cls;
+  struct GNUNET_HashCode mutated_hash;
+  unsigned int i;
+
+  for (i = fs->start; i < fs->end; i++)
+  {
+    mingle_hash (&fs->elements[i]->element_hash,
+                 &fs->salt_hash,
+                 &mutated_hash);
+    if (NULL != fs->gcs)
+      fs->keep[i] = (GNUNET_YES ==
+                     gcs_contains (fs->gcs,
+                                   fs->gcs_len,
+                                   gcs_value (&mutated_hash,
+                                              fs->gcs_range)));
+    else
+      fs->keep[i] = (GNUNET_YES ==
+                     GNUNET_CONTAINER_bloomfilter_test (fs->bf,
+                                                        &mutated_hash));
+  }
+  return NULL;
+}
+
+
+/**
+ * Add the elements of a share to a filter we build: to the
+ * share's Bloom filter, or compute their GCS values.
+ *
+ * @param cls the `struct FilterShare`
+ * @return NULL
+ */
+static void *
+build_share (void *cls)
+{
+  struct FilterShare *fs = cls;
   struct GNUNET_HashCode mutated_hash;
+  unsigned int i;
+
+  for (i = fs->start; i < fs->end; i++)
+  {
+    mingle_hash (&fs->elements[i]->element_hash,
+                 &fs->salt_hash,
+                 &mutated_hash);
+    if (NULL != fs->values)
+      fs->values[i] = gcs_value (&mutated_hash,
+                                 fs->gcs_range);
+    else
+      GNUNET_CONTAINER_bloomfilter_add (fs->bf,
+                                        &mutated_hash);
+  }
+  return NULL;
+}
+
+
+/**
+ * Determine into how many shares to split the work on @a n elements.
+ *
+ * @param n number of elements
+ * @return number of shares (and threads)
+ */
+static unsigned int
+get_share_count (unsigned int n)
+{
+  unsigned int threads = 1;
+#if HAVE_PTHREAD && defined(_SC_NPROCESSORS_ONLN)
+  long cpus;
+
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if ( (n >= FILTER_THREAD_THRESHOLD) &&
+       (cpus > 1) )
+    threads = GNUNET_MIN ((unsigned int) cpus,
+                          FILTER_MAX_THREADS);
+#endif
+  return threads;
+}
+
+
+/**
+ * Run @a fn on all shares, in parallel if possible.  The
+ * calling thread works on the first share itself.
+ *
+ * @param fn function to run on each share
+ * @param shares the shares
+ * @param num_shares number of @a shares
+ */
+static void
+run_shares (void *(*fn) (void *),
+            struct FilterShare *shares,
+            unsigned int num_shares)
+{
+  unsigned int i;
+#if HAVE_PTHREAD
+  pthread_t tid[FILTER_MAX_THREADS];
+  unsigned int started;
+
+  for (started = 1; started < num_shares; started++)
+    if (0 != pthread_create (&tid[started], NULL, fn, &shares[started]))
+      break;
+  (void) fn (&shares[0]);
+  for (i = 1; i < started; i++)
+    GNUNET_break (0 == pthread_join (tid[i], NULL));
+  /* shares we could not start a thread for */
+  for (i = started; i < num_shares; i++)
+    (void) fn (&shares[i]);
+#else
+  for (i = 0; i < num_shares; i++)
+    (void) fn (&shares[i]);
+#endif
+}
 
 
+/**
+ * Split the work on @a n elements into shares.
+ *
+ * @param template share to copy the common fields from
+ * @param n number of elements
+ * @param[out] shares set to the shares, at most #FILTER_MAX_THREADS
+ * @return number of shares
+ */
+static unsigned int
+make_shares (const struct FilterShare *template,
+             unsigned int n,
+             struct FilterShare *shares)
+{
+  unsigned int num_shares;
+  unsigned int i;
+
+  num_shares = get_share_count (n);
+  for (i = 0; i < num_shares; i++)
+  {
+    shares[i] = *template;
+    shares[i].start = (unsigned int) ((uint64_t) n * i / num_shares);
+    shares[i].end = (unsigned int) ((uint64_t) n * (i + 1) / num_shares);
+  }
+  return num_shares;
+}
+
+
+/**
+ * Test elements against the filter we received from the
+ * other peer.
+ *
+ * @param op the intersection operation
+ * @param elements elements to test
+ * @param n number of @a elements
+ * @param[out] keep set to #GNUNET_YES for the elements that pass
+ *        the filter, #GNUNET_NO for those that must be removed
+ */
+static void
+apply_remote_filter (struct Operation *op,
+                     struct ElementEntry **elements,
+                     unsigned int n,
+                     char *keep)
+{
+  struct FilterShare template;
+  struct FilterShare shares[FILTER_MAX_THREADS];
+  unsigned int num_shares;
+
+  memset (&template, 0, sizeof (template));
+  template.elements = elements;
+  GNUNET_CRYPTO_hash (&op->state->salt,
+                      sizeof (uint32_t),
+                      &template.salt_hash);
+  template.bf = op->state->remote_bf;
+  template.gcs = op->state->remote_gcs;
+  template.gcs_len = op->state->remote_gcs_len;
+  template.gcs_range = op->state->remote_gcs_range;
+  template.keep = keep;
+  num_shares = make_shares (&template, n, shares);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "FIMA called for %s:%u\n",
-              GNUNET_h2s (&ee->element_hash),
-              ee->element.size);
+              "Testing %u elements against %s with salt %u (%u threads)\n",
+              n,
+              (NULL != op->state->remote_gcs) ? "GCS" : "BF",
+              op->state->salt,
+              num_shares);
+  run_shares (&test_share,
+              shares,
+              num_shares);
+}
 
-  if (GNUNET_NO == _GSS_is_element_of_operation (ee, op))
+
+/**
+ * Collect elements from a hash map.
+ *
+ * @param cls the `struct ElementCollector`
+ * @param key current key code
+ * @param value the `struct ElementEntry *` from the hash map
+ * @return #GNUNET_YES (we should continue to iterate)
+ */
+static int
+collect_elements_iterator (void *cls,
+                           const struct GNUNET_HashCode *key,
+                           void *value)
+{
+  struct ElementCollector *ec = cls;
+  struct ElementEntry *ee = value;
+
+  if ( (NULL != ec->op) &&
+       (GNUNET_NO == _GSS_is_element_of_operation (ee, ec->op)) )
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Reduced initialization, not starting with %s:%u (wrong generation)\n",
@@ -247,84 +761,120 @@ filtered_map_initialization (void *cls,
                 ee->element.size);
     return GNUNET_YES; /* element not valid in our operation's generation */
   }
+  GNUNET_assert (ec->n < ec->size);
+  ec->elements[ec->n++] = ee;
+  return GNUNET_YES;
+}
 
-  /* Test if element is in other peer's bloomfilter */
-  GNUNET_BLOCK_mingle_hash (&ee->element_hash,
-                            op->state->salt,
-                            &mutated_hash);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Testing mingled hash %s with salt %u\n",
-              GNUNET_h2s (&mutated_hash),
-              op->state->salt);
-  if (GNUNET_NO ==
-      GNUNET_CONTAINER_bloomfilter_test (op->state->remote_bf,
-                                         &mutated_hash))
+
+/**
+ * Collect the elements of a hash map into an array.
+ *
+ * @param map the map of `struct ElementEntry *`s
+ * @param op operation to filter the elements by generation,
+ *        NULL to collect all elements
+ * @param[out] n set to the number of elements collected
+ * @return array of the elements (to be freed by the caller)
+ */
+static struct ElementEntry **
+collect_elements (struct GNUNET_CONTAINER_MultiHashMap *map,
+                  struct Operation *op,
+                  unsigned int *n)
+{
+  struct ElementCollector ec;
+
+  ec.op = op;
+  ec.n = 0;
+  ec.size = GNUNET_CONTAINER_multihashmap_size (map);
+  ec.elements = GNUNET_new_array (ec.size + 1,
+                                  struct ElementEntry *);
+  GNUNET_CONTAINER_multihashmap_iterate (map,
+                                         &collect_elements_iterator,
+                                         &ec);
+  *n = ec.n;
+  return ec.elements;
+}
+
+
+/**
+ * Fills the "my_elements" hashmap with the elements of the set
+ * that pass the first filter of the other peer.
+ *
+ * @param op the `struct Operation *` we are performing
+ */
+static void
+filtered_map_initialization (struct Operation *op)
+{
+  struct ElementEntry **elements;
+  unsigned int n;
+  unsigned int i;
+  char *keep;
+
+  elements = collect_elements (op->spec->set->content->elements,
+                               op,
+                               &n);
+  keep = GNUNET_malloc (n + 1);
+  apply_remote_filter (op, elements, n, keep);
+  for (i = 0; i < n; i++)
   {
-    /* remove this element */
-    send_client_removed_element (op,
-                                 &ee->element);
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Reduced initialization, not starting with %s:%u\n",
-                GNUNET_h2s (&ee->element_hash),
-                ee->element.size);
-    return GNUNET_YES;
+    struct ElementEntry *ee = elements[i];
+
+    if (! keep[i])
+    {
+      /* remove this element */
+      send_client_removed_element (op,
+                                   &ee->element);
+      continue;
+    }
+    op->state->my_element_count++;
+    GNUNET_CRYPTO_hash_xor (&op->state->my_xor,
+                            &ee->element_hash,
+                            &op->state->my_xor);
+    GNUNET_break (GNUNET_YES ==
+                  GNUNET_CONTAINER_multihashmap_put (op->state->my_elements,
+                                                     &ee->element_hash,
+                                                     ee,
+                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
   }
-  op->state->my_element_count++;
-  GNUNET_CRYPTO_hash_xor (&op->state->my_xor,
-                          &ee->element_hash,
-                          &op->state->my_xor);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Filtered initialization of my_elements, adding %s:%u\n",
-              GNUNET_h2s (&ee->element_hash),
-              ee->element.size);
-  GNUNET_break (GNUNET_YES ==
-                GNUNET_CONTAINER_multihashmap_put (op->state->my_elements,
-                                                   &ee->element_hash,
-                                                   ee,
-                                                   GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
-
-  return GNUNET_YES;
+              "Filtered initialization of my_elements kept %u/%u elements\n",
+              op->state->my_element_count,
+              n);
+  GNUNET_free (keep);
+  GNUNET_free (elements);
 }
 
 
 /**
  * Removes elements from our hashmap if they are not contained within the
- * provided remote bloomfilter.
+ * provided remote filter.
  *
- * @param cls closure with the `struct Operation *`
- * @param key current key code
- * @param value value in the hash map
- * @return #GNUNET_YES (we should continue to iterate)
+ * @param op the `struct Operation *` we are performing
  */
-static int
-iterator_bf_reduce (void *cls,
-                   const struct GNUNET_HashCode *key,
-                   void *value)
+static void
+bf_reduce (struct Operation *op)
 {
-  struct Operation *op = cls;
-  struct ElementEntry *ee = value;
-  struct GNUNET_HashCode mutated_hash;
-
-  GNUNET_BLOCK_mingle_hash (&ee->element_hash,
-                            op->state->salt,
-                            &mutated_hash);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Testing mingled hash %s with salt %u\n",
-              GNUNET_h2s (&mutated_hash),
-              op->state->salt);
-  if (GNUNET_NO ==
-      GNUNET_CONTAINER_bloomfilter_test (op->state->remote_bf,
-                                         &mutated_hash))
+  struct ElementEntry **elements;
+  unsigned int n;
+  unsigned int i;
+  char *keep;
+
+  elements = collect_elements (op->state->my_elements,
+                               NULL,
+                               &n);
+  keep = GNUNET_malloc (n + 1);
+  apply_remote_filter (op, elements, n, keep);
+  for (i = 0; i < n; i++)
   {
+    struct ElementEntry *ee = elements[i];
+
+    if (keep[i])
+      continue;
     GNUNET_break (0 < op->state->my_element_count);
     op->state->my_element_count--;
     GNUNET_CRYPTO_hash_xor (&op->state->my_xor,
                             &ee->element_hash,
                             &op->state->my_xor);
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Bloom filter reduction of my_elements, removing %s:%u\n",
-                GNUNET_h2s (&ee->element_hash),
-                ee->element.size);
     GNUNET_assert (GNUNET_YES ==
                    GNUNET_CONTAINER_multihashmap_remove (op->state->my_elements,
                                                          &ee->element_hash,
@@ -332,44 +882,129 @@ iterator_bf_reduce (void *cls,
     send_client_removed_element (op,
                                  &ee->element);
   }
-  else
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Bloom filter reduction of my_elements, keeping %s:%u\n",
-                GNUNET_h2s (&ee->element_hash),
-                ee->element.size);
-  }
-  return GNUNET_YES;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Bloom filter reduction of my_elements kept %u/%u elements\n",
+              op->state->my_element_count,
+              n);
+  GNUNET_free (keep);
+  GNUNET_free (elements);
 }
 
 
 /**
- * Create initial bloomfilter based on all the elements given.
+ * Build the filter over our remaining elements.  If @a compact,
+ * uses a Golomb-compressed set if that is smaller than a Bloom
+ * filter with the same false-positive rate, and a blocked Bloom
+ * filter otherwise.
  *
- * @param cls the `struct Operation *`
- * @param key current key code
- * @param value the `struct ElementEntry` to process
- * @return #GNUNET_YES (we should continue to iterate)
+ * @param op intersection operation
+ * @param bf_elementbits bits per element (k) of the Bloom filter
+ * @param bf_size size of the Bloom filter
+ * @param compact #GNUNET_YES if the other peer understands the
+ *        compact encodings, #GNUNET_NO for a plain Bloom filter
+ * @param[out] encoding set to the `enum IntersectionFilterEncoding`
+ * @param[out] param set to the bits per element to put into the message
+ * @param[out] size set to the size of the result
+ * @return the filter data
  */
-static int
-iterator_bf_create (void *cls,
-                    const struct GNUNET_HashCode *key,
-                    void *value)
+static char *
+build_filter (struct Operation *op,
+              uint32_t bf_elementbits,
+              uint32_t bf_size,
+              int compact,
+              uint32_t *encoding,
+              uint32_t *param,
+              uint32_t *size)
 {
-  struct Operation *op = cls;
-  struct ElementEntry *ee = value;
-  struct GNUNET_HashCode mutated_hash;
-
-  GNUNET_BLOCK_mingle_hash (&ee->element_hash,
-                            op->state->salt,
-                            &mutated_hash);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Initializing BF with hash %s with salt %u\n",
-              GNUNET_h2s (&mutated_hash),
-              op->state->salt);
-  GNUNET_CONTAINER_bloomfilter_add (op->state->local_bf,
-                                    &mutated_hash);
-  return GNUNET_YES;
+  struct FilterShare template;
+  struct FilterShare shares[FILTER_MAX_THREADS];
+  struct ElementEntry **elements;
+  unsigned int num_shares;
+  unsigned int n;
+  unsigned int i;
+  unsigned int gcs_bits;
+  double fp;
+  char *data;
+
+  elements = collect_elements (op->state->my_elements,
+                               NULL,
+                               &n);
+  memset (&template, 0, sizeof (template));
+  template.elements = elements;
+  GNUNET_CRYPTO_hash (&op->state->salt,
+                      sizeof (uint32_t),
+                      &template.salt_hash);
+  /* false-positive rate of the Bloom filter, and the number of
+     remainder bits a GCS needs for the same rate */
+  fp = pow (1.0 - exp (- (double) bf_elementbits * n / (8.0 * bf_size)),
+            bf_elementbits);
+  gcs_bits = (fp > 0.0) ? (unsigned int) ceil (- log2 (fp)) : GCS_MAX_BITS;
+  gcs_bits = GNUNET_MAX (1, GNUNET_MIN (gcs_bits, GCS_MAX_BITS));
+  if ( (GNUNET_YES == compact) &&
+       (n > 0) &&
+       ((uint64_t) n * (gcs_bits + 2) / 8 < bf_size) )
+  {
+    uint64_t *values;
+
+    values = GNUNET_malloc_large ((n + 1) * sizeof (uint64_t));
+    GNUNET_assert (NULL != values);
+    template.values = values;
+    template.gcs_range = ((uint64_t) n) << gcs_bits;
+    num_shares = make_shares (&template, n, shares);
+    run_shares (&build_share,
+                shares,
+                num_shares);
+    qsort (values, n, sizeof (uint64_t), &gcs_value_cmp);
+    data = gcs_encode (values, n, gcs_bits, size);
+    GNUNET_free (values);
+    *encoding = INTERSECTION_FILTER_GCS;
+    *param = gcs_bits;
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Built GCS with %u bits per element, %u bytes instead of %u\n",
+                gcs_bits,
+                (unsigned int) *size,
+                (unsigned int) bf_size);
+  }
+  else
+  {
+    num_shares = make_shares (&template, n, shares);
+    /* each share adds to a filter of its own, which we merge */
+    for (i = 0; i < num_shares; i++)
+    {
+      if (GNUNET_YES == compact)
+        shares[i].bf = GNUNET_CONTAINER_bloomfilter_init_blocked (NULL,
+                                                                  bf_size,
+                                                                  bf_elementbits);
+      else
+        shares[i].bf = GNUNET_CONTAINER_bloomfilter_init (NULL,
+                                                          bf_size,
+                                                          bf_elementbits);
+      GNUNET_assert (NULL != shares[i].bf);
+    }
+    run_shares (&build_share,
+                shares,
+                num_shares);
+    for (i = 1; i < num_shares; i++)
+    {
+      GNUNET_break (GNUNET_OK ==
+                    GNUNET_CONTAINER_bloomfilter_or2 (shares[0].bf,
+                                                      shares[i].bf));
+      GNUNET_CONTAINER_bloomfilter_free (shares[i].bf);
+    }
+    data = GNUNET_malloc (bf_size);
+    GNUNET_assert (GNUNET_SYSERR !=
+                   GNUNET_CONTAINER_bloomfilter_get_raw_data (shares[0].bf,
+                                                              data,
+                                                              bf_size));
+    GNUNET_CONTAINER_bloomfilter_free (shares[0].bf);
+    *encoding = (GNUNET_YES == compact)
+      ? INTERSECTION_FILTER_BLOCKED_BF
+      : INTERSECTION_FILTER_BF;
+    *param = bf_elementbits;
+    *size = bf_size;
+  }
+  GNUNET_free (elements);
+  return data;
 }
 
 
@@ -405,8 +1040,26 @@ fail_intersection_operation (struct Operation *op)
 
 
 /**
- * Send a bloomfilter to our peer.  After the result done message has
- * been sent to the client, destroy the evaluate operation.
+ * Compute the size of a plain Bloom filter the way all versions
+ * of this service do, optimized for ~50% of the bits set.
+ *
+ * @param element_count number of elements in the filter
+ * @param bf_elementbits bits per element (k)
+ * @return size of the filter in bytes
+ */
+static uint32_t
+plain_bf_size (uint32_t element_count,
+               uint32_t bf_elementbits)
+{
+  return ceil ((double) (element_count * bf_elementbits / log(2)));
+}
+
+
+/**
+ * Send a bloomfilter to our peer.  Peers that understand compact
+ * filters get a #GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER,
+ * all others a plain Bloom filter, which is one byte larger than
+ * necessary to tell them that we understand compact filters.
  *
  * @param op intersection operation
  */
@@ -414,11 +1067,13 @@ static void
 send_bloomfilter (struct Operation *op)
 {
   struct GNUNET_MQ_Envelope *ev;
-  struct BFMessage *msg;
   uint32_t bf_size;
   uint32_t bf_elementbits;
   uint32_t chunk_size;
-  char *bf_data;
+  uint32_t encoding;
+  uint32_t param;
+  uint32_t size;
+  char *data;
   uint32_t offset;
 
   /* We consider the ratio of the set sizes to determine
@@ -430,73 +1085,77 @@ send_bloomfilter (struct Operation *op)
                                    (double) op->state->my_element_count)));
   if (bf_elementbits < 1)
     bf_elementbits = 1; /* make sure k is not 0 */
-  /* optimize BF-size to ~50% of bits set */
-  bf_size = ceil ((double) (op->state->my_element_count
-                            * bf_elementbits / log(2)));
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Sending Bloom filter (%u) of size %u bytes\n",
-              (unsigned int) bf_elementbits,
-              (unsigned int) bf_size);
-  op->state->local_bf = GNUNET_CONTAINER_bloomfilter_init (NULL,
-                                                           bf_size,
-                                                           bf_elementbits);
+  bf_size = plain_bf_size (op->state->my_element_count,
+                           bf_elementbits);
+  if (GNUNET_YES == op->state->remote_filter_ok)
+    /* blocked filters consist of whole 64 byte blocks */
+    bf_size = GNUNET_MAX (64, (bf_size + 63) / 64 * 64);
+  else
+    bf_size++; /* announce that we understand compact filters */
   op->state->salt = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_NONCE,
                                               UINT32_MAX);
-  GNUNET_CONTAINER_multihashmap_iterate (op->state->my_elements,
-                                         &iterator_bf_create,
-                                         op);
-
-  /* send our Bloom filter */
-  chunk_size = 60 * 1024 - sizeof (struct BFMessage);
-  if (bf_size <= chunk_size)
-  {
-    /* singlepart */
-    chunk_size = bf_size;
-    ev = GNUNET_MQ_msg_extra (msg,
-                              chunk_size,
-                              GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_BF);
-    GNUNET_assert (GNUNET_SYSERR !=
-                   GNUNET_CONTAINER_bloomfilter_get_raw_data (op->state->local_bf,
-                                                              (char*) &msg[1],
-                                                              bf_size));
-    msg->sender_element_count = htonl (op->state->my_element_count);
-    msg->bloomfilter_total_length = htonl (bf_size);
-    msg->bits_per_element = htonl (bf_elementbits);
-    msg->sender_mutator = htonl (op->state->salt);
-    msg->element_xor_hash = op->state->my_xor;
-    GNUNET_MQ_send (op->mq, ev);
-  }
-  else
+  data = build_filter (op,
+                       bf_elementbits,
+                       bf_size,
+                       op->state->remote_filter_ok,
+                       &encoding,
+                       &param,
+                       &size);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Sending filter (encoding %u, %u) of size %u bytes\n",
+              (unsigned int) encoding,
+              (unsigned int) param,
+              (unsigned int) size);
+  GNUNET_STATISTICS_update (_GSS_statistics,
+                            "# intersection filter rounds",
+                            1,
+                            GNUNET_NO);
+
+  /* send our filter, in several parts if needed */
+  chunk_size = 60 * 1024 - sizeof (struct FilterMessage);
+  offset = 0;
+  do
   {
-    /* multipart */
-    bf_data = GNUNET_malloc (bf_size);
-    GNUNET_assert (GNUNET_SYSERR !=
-                   GNUNET_CONTAINER_bloomfilter_get_raw_data (op->state->local_bf,
-                                                              bf_data,
-                                                              bf_size));
-    offset = 0;
-    while (offset < bf_size)
+    if (size - offset < chunk_size)
+      chunk_size = size - offset;
+    if (GNUNET_YES == op->state->remote_filter_ok)
+    {
+      struct FilterMessage *msg;
+
+      ev = GNUNET_MQ_msg_extra (msg,
+                                chunk_size,
+                                GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER);
+      memcpy (&msg[1],
+              &data[offset],
+              chunk_size);
+      msg->sender_element_count = htonl (op->state->my_element_count);
+      msg->filter_total_length = htonl (size);
+      msg->bits_per_element = htonl (param);
+      msg->encoding = htonl (encoding);
+      msg->sender_mutator = htonl (op->state->salt);
+      msg->element_xor_hash = op->state->my_xor;
+    }
+    else
     {
-      if (bf_size - chunk_size < offset)
-        chunk_size = bf_size - offset;
+      struct BFMessage *msg;
+
       ev = GNUNET_MQ_msg_extra (msg,
                                 chunk_size,
                                 GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_BF);
       memcpy (&msg[1],
-              &bf_data[offset],
+              &data[offset],
               chunk_size);
-      offset += chunk_size;
       msg->sender_element_count = htonl (op->state->my_element_count);
-      msg->bloomfilter_total_length = htonl (bf_size);
-      msg->bits_per_element = htonl (bf_elementbits);
+      msg->bloomfilter_total_length = htonl (size);
+      msg->bits_per_element = htonl (param);
       msg->sender_mutator = htonl (op->state->salt);
       msg->element_xor_hash = op->state->my_xor;
-      GNUNET_MQ_send (op->mq, ev);
     }
-    GNUNET_free (bf_data);
+    offset += chunk_size;
+    GNUNET_MQ_send (op->mq, ev);
   }
-  GNUNET_CONTAINER_bloomfilter_free (op->state->local_bf);
-  op->state->local_bf = NULL;
+  while (offset < size);
+  GNUNET_free (data);
 }
 
 
@@ -591,8 +1250,6 @@ send_peer_done (struct Operation *op)
   op->state->phase = PHASE_FINISHED;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Intersection succeeded, sending DONE\n");
-  GNUNET_CONTAINER_bloomfilter_free (op->state->local_bf);
-  op->state->local_bf = NULL;
 
   ev = GNUNET_MQ_msg (idm,
                       GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_DONE);
@@ -630,23 +1287,24 @@ process_bf (struct Operation *op)
       = GNUNET_CONTAINER_multihashmap_create (op->spec->remote_element_count,
                                               GNUNET_YES);
     op->state->my_element_count = 0;
-    GNUNET_CONTAINER_multihashmap_iterate (op->spec->set->content->elements,
-                                           &filtered_map_initialization,
-                                           op);
+    filtered_map_initialization (op);
     break;
   case PHASE_BF_EXCHANGE:
     /* Update our set by reduction */
-    GNUNET_CONTAINER_multihashmap_iterate (op->state->my_elements,
-                                           &iterator_bf_reduce,
-                                           op);
+    bf_reduce (op);
     break;
   case PHASE_FINISHED:
     GNUNET_break_op (0);
     fail_intersection_operation(op);
     return;
   }
-  GNUNET_CONTAINER_bloomfilter_free (op->state->remote_bf);
-  op->state->remote_bf = NULL;
+  if (NULL != op->state->remote_bf)
+  {
+    GNUNET_CONTAINER_bloomfilter_free (op->state->remote_bf);
+    op->state->remote_bf = NULL;
+  }
+  GNUNET_free_non_null (op->state->remote_gcs);
+  op->state->remote_gcs = NULL;
 
   if ( (0 == op->state->my_element_count) || /* fully disjoint */
        ( (op->state->my_element_count == op->spec->remote_element_count) &&
@@ -664,30 +1322,77 @@ process_bf (struct Operation *op)
 
 
 /**
- * Handle an BF message from a remote peer.
+ * Set up the filter we received from the other peer.
  *
- * @param cls the intersection operation
- * @param mh the header of the message
+ * @param op the intersection operation
+ * @param data the filter data
+ * @param size number of bytes in @a data
+ * @param bits_per_element k of a Bloom filter, remainder bits of a GCS
+ * @param encoding the `enum IntersectionFilterEncoding`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the filter is malformed
  */
-static void
-handle_p2p_bf (void *cls,
-               const struct GNUNET_MessageHeader *mh)
+static int
+load_remote_filter (struct Operation *op,
+                    const char *data,
+                    uint32_t size,
+                    uint32_t bits_per_element,
+                    uint32_t encoding)
 {
-  struct Operation *op = cls;
-  const struct BFMessage *msg;
-  uint32_t bf_size;
-  uint32_t chunk_size;
-  uint32_t bf_bits_per_element;
-  uint16_t msize;
-
-  msize = htons (mh->size);
-  if (msize < sizeof (struct BFMessage))
+  switch (encoding)
   {
-    GNUNET_break_op (0);
-    fail_intersection_operation (op);
-    return;
+  case INTERSECTION_FILTER_BF:
+    op->state->remote_bf
+      = GNUNET_CONTAINER_bloomfilter_init (data,
+                                           size,
+                                           bits_per_element);
+    return (NULL == op->state->remote_bf) ? GNUNET_SYSERR : GNUNET_OK;
+  case INTERSECTION_FILTER_BLOCKED_BF:
+    op->state->remote_bf
+      = GNUNET_CONTAINER_bloomfilter_init_blocked (data,
+                                                   size,
+                                                   bits_per_element);
+    return (NULL == op->state->remote_bf) ? GNUNET_SYSERR : GNUNET_OK;
+  case INTERSECTION_FILTER_GCS:
+    if ( (0 == bits_per_element) ||
+         (bits_per_element > GCS_MAX_BITS) )
+      return GNUNET_SYSERR;
+    op->state->remote_gcs_len = op->spec->remote_element_count;
+    op->state->remote_gcs_range
+      = ((uint64_t) op->state->remote_gcs_len) << bits_per_element;
+    return gcs_decode (data,
+                       size,
+                       op->state->remote_gcs_len,
+                       bits_per_element,
+                       &op->state->remote_gcs);
+  default:
+    return GNUNET_SYSERR;
   }
-  msg = (const struct BFMessage *) mh;
+}
+
+
+/**
+ * Handle (a part of) a filter from a remote peer.  The caller
+ * already updated the `other_xor` of the operation.
+ *
+ * @param op the intersection operation
+ * @param sender_element_count number of elements the sender has
+ * @param sender_mutator salt used for the filter
+ * @param total_length total size of the filter
+ * @param bits_per_element parameter of the filter
+ * @param encoding the `enum IntersectionFilterEncoding`
+ * @param chunk the part of the filter in this message
+ * @param chunk_size number of bytes in @a chunk
+ */
+static void
+handle_filter_part (struct Operation *op,
+                    uint32_t sender_element_count,
+                    uint32_t sender_mutator,
+                    uint32_t total_length,
+                    uint32_t bits_per_element,
+                    uint32_t encoding,
+                    const char *chunk,
+                    uint32_t chunk_size)
+{
   switch (op->state->phase)
   {
   case PHASE_INITIAL:
@@ -696,11 +1401,7 @@ handle_p2p_bf (void *cls,
     break;
   case PHASE_COUNT_SENT:
   case PHASE_BF_EXCHANGE:
-    bf_size = ntohl (msg->bloomfilter_total_length);
-    bf_bits_per_element = ntohl (msg->bits_per_element);
-    chunk_size = msize - sizeof (struct BFMessage);
-    op->state->other_xor = msg->element_xor_hash;
-    if (bf_size == chunk_size)
+    if (total_length == chunk_size)
     {
       if (NULL != op->state->bf_data)
       {
@@ -709,12 +1410,19 @@ handle_p2p_bf (void *cls,
         return;
       }
       /* single part, done here immediately */
-      op->state->remote_bf
-        = GNUNET_CONTAINER_bloomfilter_init ((const char*) &msg[1],
-                                             bf_size,
-                                             bf_bits_per_element);
-      op->state->salt = ntohl (msg->sender_mutator);
-      op->spec->remote_element_count = ntohl (msg->sender_element_count);
+      op->state->salt = sender_mutator;
+      op->spec->remote_element_count = sender_element_count;
+      if (GNUNET_OK !=
+          load_remote_filter (op,
+                              chunk,
+                              total_length,
+                              bits_per_element,
+                              encoding))
+      {
+        GNUNET_break_op (0);
+        fail_intersection_operation (op);
+        return;
+      }
       process_bf (op);
       return;
     }
@@ -722,21 +1430,23 @@ handle_p2p_bf (void *cls,
     if (NULL == op->state->bf_data)
     {
       /* first chunk, initialize */
-      op->state->bf_data = GNUNET_malloc (bf_size);
-      op->state->bf_data_size = bf_size;
-      op->state->bf_bits_per_element = bf_bits_per_element;
+      op->state->bf_data = GNUNET_malloc (total_length);
+      op->state->bf_data_size = total_length;
+      op->state->bf_bits_per_element = bits_per_element;
+      op->state->bf_encoding = encoding;
       op->state->bf_data_offset = 0;
-      op->state->salt = ntohl (msg->sender_mutator);
-      op->spec->remote_element_count = ntohl (msg->sender_element_count);
+      op->state->salt = sender_mutator;
+      op->spec->remote_element_count = sender_element_count;
     }
     else
     {
       /* increment */
-      if ( (op->state->bf_data_size != bf_size) ||
-           (op->state->bf_bits_per_element != bf_bits_per_element) ||
-           (op->state->bf_data_offset + chunk_size > bf_size) ||
-           (op->state->salt != ntohl (msg->sender_mutator)) ||
-           (op->spec->remote_element_count != ntohl (msg->sender_element_count)) )
+      if ( (op->state->bf_data_size != total_length) ||
+           (op->state->bf_bits_per_element != bits_per_element) ||
+           (op->state->bf_encoding != encoding) ||
+           (op->state->bf_data_offset + chunk_size > total_length) ||
+           (op->state->salt != sender_mutator) ||
+           (op->spec->remote_element_count != sender_element_count) )
       {
         GNUNET_break_op (0);
         fail_intersection_operation (op);
@@ -744,16 +1454,23 @@ handle_p2p_bf (void *cls,
       }
     }
     memcpy (&op->state->bf_data[op->state->bf_data_offset],
-            (const char*) &msg[1],
+            chunk,
             chunk_size);
     op->state->bf_data_offset += chunk_size;
-    if (op->state->bf_data_offset == bf_size)
+    if (op->state->bf_data_offset == total_length)
     {
       /* last chunk, run! */
-      op->state->remote_bf
-        = GNUNET_CONTAINER_bloomfilter_init (op->state->bf_data,
-                                             bf_size,
-                                             bf_bits_per_element);
+      if (GNUNET_OK !=
+          load_remote_filter (op,
+                              op->state->bf_data,
+                              total_length,
+                              bits_per_element,
+                              encoding))
+      {
+        GNUNET_break_op (0);
+        fail_intersection_operation (op);
+        return;
+      }
       GNUNET_free (op->state->bf_data);
       op->state->bf_data = NULL;
       op->state->bf_data_size = 0;
@@ -768,6 +1485,84 @@ handle_p2p_bf (void *cls,
 }
 
 
+/**
+ * Handle an BF message from a remote peer.
+ *
+ * @param cls the intersection operation
+ * @param mh the header of the message
+ */
+static void
+handle_p2p_bf (void *cls,
+               const struct GNUNET_MessageHeader *mh)
+{
+  struct Operation *op = cls;
+  const struct BFMessage *msg;
+  uint32_t bf_size;
+  uint32_t bf_bits_per_element;
+  uint32_t sender_element_count;
+  uint16_t msize;
+
+  msize = htons (mh->size);
+  if (msize < sizeof (struct BFMessage))
+  {
+    GNUNET_break_op (0);
+    fail_intersection_operation (op);
+    return;
+  }
+  msg = (const struct BFMessage *) mh;
+  bf_size = ntohl (msg->bloomfilter_total_length);
+  bf_bits_per_element = ntohl (msg->bits_per_element);
+  sender_element_count = ntohl (msg->sender_element_count);
+  op->state->other_xor = msg->element_xor_hash;
+  if (bf_size == plain_bf_size (sender_element_count,
+                                bf_bits_per_element) + 1)
+    op->state->remote_filter_ok = GNUNET_YES;
+  handle_filter_part (op,
+                      sender_element_count,
+                      ntohl (msg->sender_mutator),
+                      bf_size,
+                      bf_bits_per_element,
+                      INTERSECTION_FILTER_BF,
+                      (const char *) &msg[1],
+                      msize - sizeof (struct BFMessage));
+}
+
+
+/**
+ * Handle a compact filter message from a remote peer.
+ *
+ * @param cls the intersection operation
+ * @param mh the header of the message
+ */
+static void
+handle_p2p_filter (void *cls,
+                   const struct GNUNET_MessageHeader *mh)
+{
+  struct Operation *op = cls;
+  const struct FilterMessage *msg;
+  uint16_t msize;
+
+  msize = htons (mh->size);
+  if (msize < sizeof (struct FilterMessage))
+  {
+    GNUNET_break_op (0);
+    fail_intersection_operation (op);
+    return;
+  }
+  msg = (const struct FilterMessage *) mh;
+  op->state->remote_filter_ok = GNUNET_YES;
+  op->state->other_xor = msg->element_xor_hash;
+  handle_filter_part (op,
+                      ntohl (msg->sender_element_count),
+                      ntohl (msg->sender_mutator),
+                      ntohl (msg->filter_total_length),
+                      ntohl (msg->bits_per_element),
+                      ntohl (msg->encoding),
+                      (const char *) &msg[1],
+                      msize - sizeof (struct FilterMessage));
+}
+
+
 /**
  * Fills the "my_elements" hashmap with the initial set of
  * (non-deleted) elements from the set of the specification.
@@ -1108,6 +1903,9 @@ intersection_handle_p2p_message (struct Operation *op,
   case GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_BF:
     handle_p2p_bf (op, mh);
     break;
+  case GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER:
+    handle_p2p_filter (op, mh);
+    break;
   case GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_DONE:
     handle_p2p_done (op, mh);
     break;
@@ -1158,11 +1956,10 @@ intersection_op_cancel (struct Operation *op)
     GNUNET_CONTAINER_bloomfilter_free (op->state->remote_bf);
     op->state->remote_bf = NULL;
   }
-  if (NULL != op->state->local_bf)
-  {
-    GNUNET_CONTAINER_bloomfilter_free (op->state->local_bf);
-    op->state->local_bf = NULL;
-  }
+  GNUNET_free_non_null (op->state->remote_gcs);
+  op->state->remote_gcs = NULL;
+  GNUNET_free_non_null (op->state->bf_data);
+  op->state->bf_data = NULL;
   if (NULL != op->state->my_elements)
   {
     GNUNET_CONTAINER_multihashmap_destroy (op->state->my_elements);
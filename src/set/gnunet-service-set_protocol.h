@@ -58,6 +58,15 @@ struct OperationRequestMessage
 };
 
 
+/**
+ * Flag in the `flags` of an `struct IBFMessage`: the sender answers
+ * a #GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF_MORE with another segment
+ * of its IBF.  Peers that do not set it must not be sent that message,
+ * they expect a larger IBF in return instead.
+ */
+#define IBF_FLAG_MORE_SEGMENTS 1
+
+
 struct IBFMessage
 {
   /**
@@ -66,15 +75,16 @@ struct IBFMessage
   struct GNUNET_MessageHeader header;
 
   /**
-   * Order of the whole ibf, where
+   * Order of the whole ibf (segment), where
    * num_buckets = 2^order
    */
   uint8_t order;
 
   /**
-   * Padding, must be 0.
+   * Combination of the IBF_FLAG_* values.  Was padding (always 0)
+   * in older versions of the protocol.
    */
-  uint8_t reserved;
+  uint8_t flags;
 
   /**
    * Offset of the strata in the rest of the message
@@ -82,7 +92,9 @@ struct IBFMessage
   uint16_t offset GNUNET_PACKED;
 
   /**
-   * Salt used when hashing elements for this IBF.
+   * Salt used when hashing keys into the buckets of this IBF.
+   * Successive segments of an IBF use the salts 0, 1, 2, ...;
+   * a new IBF (salt 0) starts over.
    */
   uint32_t salt GNUNET_PACKED;
 
@@ -110,6 +122,33 @@ struct IntersectionElementInfoMessage
 };
 
 
+/**
+ * Encodings of the element filters exchanged for set intersection.
+ */
+enum IntersectionFilterEncoding
+{
+  /**
+   * Plain Bloom filter, as sent in a `struct BFMessage`.
+   */
+  INTERSECTION_FILTER_BF = 0,
+
+  /**
+   * Blocked Bloom filter (see
+   * #GNUNET_CONTAINER_bloomfilter_init_blocked()).
+   */
+  INTERSECTION_FILTER_BLOCKED_BF = 1,
+
+  /**
+   * Golomb-compressed set: the sorted values of the elements'
+   * (mingled) hashes, reduced modulo element count times
+   * 2^bits_per_element, delta-encoded with a Golomb-Rice code
+   * (quotient in unary, terminated by a 0 bit, followed by the
+   * bits_per_element remainder bits; most significant bit first).
+   */
+  INTERSECTION_FILTER_GCS = 2
+};
+
+
 /**
  * Bloom filter messages exchanged for set intersection calculation.
  */
@@ -152,6 +191,59 @@ struct BFMessage
 };
 
 
+/**
+ * Compact filter messages exchanged for set intersection.  Only
+ * sent to peers that announced support for them: such peers make
+ * the total length of their (first) `struct BFMessage` one byte
+ * larger than the ceil (count * k / ln 2) bytes older peers use.
+ */
+struct FilterMessage
+{
+  /**
+   * Type: #GNUNET_MESSAGE_TYPE_SET_INTERSECTION_P2P_FILTER
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of elements the sender still has in the set.
+   */
+  uint32_t sender_element_count GNUNET_PACKED;
+
+  /**
+   * XOR of all hashes over all elements remaining in the set.
+   * Used to determine termination.
+   */
+  struct GNUNET_HashCode element_xor_hash;
+
+  /**
+   * Mutator used with this filter.
+   */
+  uint32_t sender_mutator GNUNET_PACKED;
+
+  /**
+   * Total length of the filter data.
+   */
+  uint32_t filter_total_length GNUNET_PACKED;
+
+  /**
+   * Number of bits (k-value) of a Bloom filter; for
+   * #INTERSECTION_FILTER_GCS, the number of remainder bits
+   * of the Golomb-Rice code.
+   */
+  uint32_t bits_per_element GNUNET_PACKED;
+
+  /**
+   * Encoding of the filter, a `enum IntersectionFilterEncoding`
+   * in NBO.
+   */
+  uint32_t encoding GNUNET_PACKED;
+
+  /**
+   * rest: the sender's filter
+   */
+};
+
+
 /**
  * Last message, send to confirm the final set.  Contains the element
  * count as it is possible that the peer determined that we were done
@@ -62,6 +62,13 @@
  */
 #define IBF_ALPHA 4
 
+/**
+ * Maximum number of IBF segments we send (or accept) for one
+ * operation.  Each further segment is twice as large as the
+ * previous one (up to 2^(MAX_IBF_ORDER)).
+ */
+#define MAX_IBF_SEGMENTS 8
+
 
 /**
  * Current phase we are in for a union operation.
@@ -75,7 +82,7 @@ enum UnionOperationPhase
 
   /**
    * We sent the strata estimator, and expect an IBF. This phase is entered once
-   * upon initialization and later via #PHASE_EXPECT_ELEMENTS_AND_REQUESTS.
+   * upon initialization.
    *
    * After receiving the complete IBF, we enter #PHASE_EXPECT_ELEMENTS
    */
@@ -93,6 +100,9 @@ enum UnionOperationPhase
    * We are currently decoding an IBF until it can no longer be decoded,
    * we currently send requests and expect elements
    * The remote peer is in #PHASE_EXPECT_ELEMENTS_AND_REQUESTS
+   *
+   * If decoding gets stuck, we ask for another IBF segment and
+   * receive it in this phase, continuing to decode where we stopped.
    */
   PHASE_EXPECT_ELEMENTS,
 
@@ -101,8 +111,8 @@ enum UnionOperationPhase
    * requested elements back to the other peer.
    *
    * We are in this phase if we have SENT an IBF for the remote peer to decode.
-   * We expect requests, send elements or could receive an new IBF, which takes
-   * us via #PHASE_EXPECT_IBF to phase #PHASE_EXPECT_ELEMENTS
+   * We expect requests, send elements or could be asked for another
+   * IBF segment.
    *
    * The remote peer is thus in:
    * #PHASE_EXPECT_ELEMENTS
@@ -140,16 +150,32 @@ struct OperationState
   struct InvertibleBloomFilter *local_ibf;
 
   /**
-   * Maps IBF-Keys (specific to the current salt) to elements.
+   * Maps IBF-Keys to the elements we received from the remote peer.
    * Used as a multihashmap, the keys being the lower 32bit of the IBF-Key.
-   * Colliding IBF-Keys are linked.
+   * Colliding IBF-Keys are linked.  Our own elements are found
+   * in the `struct KeyIndex` of the set.
    */
-  struct GNUNET_CONTAINER_MultiHashMap32 *key_to_element;
+  struct GNUNET_CONTAINER_MultiHashMap32 *remote_elements;
 
   /**
-   * Iterator for sending elements on the key to element mapping to the client.
+   * Elements of the full result, to be sent to the client.
    */
-  struct GNUNET_CONTAINER_MultiHashMap32Iterator *full_result_iter;
+  struct ElementEntry **full_result;
+
+  /**
+   * Number of elements in @e full_result.
+   */
+  unsigned int full_result_len;
+
+  /**
+   * Allocated length of @e full_result.
+   */
+  unsigned int full_result_size;
+
+  /**
+   * Number of elements of @e full_result sent to the client.
+   */
+  unsigned int full_result_pos;
 
   /**
    * Current state of the operation.
@@ -166,6 +192,73 @@ struct OperationState
    */
   unsigned int ibf_buckets_received;
 
+  /**
+   * Differences between the local IBF segments and the
+   * remote IBF segments received so far, partially decoded.
+   * Array of @e num_diff_ibfs entries.
+   */
+  struct InvertibleBloomFilter **diff_ibfs;
+
+  /**
+   * Number of entries in @e diff_ibfs.
+   */
+  unsigned int num_diff_ibfs;
+
+  /**
+   * Keys decoded so far, they have to be removed from
+   * further IBF segments.
+   */
+  struct DecodedKey *decoded;
+
+  /**
+   * Number of keys in @e decoded.
+   */
+  unsigned int num_decoded;
+
+  /**
+   * Allocated length of @e decoded.
+   */
+  unsigned int decoded_size;
+
+  /**
+   * Did we ask the remote peer for another IBF segment?
+   */
+  int ibf_more_requested;
+
+  /**
+   * Does the remote peer send further IBF segments on request?
+   * Set from the flags of the last IBF we received.
+   */
+  int remote_ibf_more;
+
+  /**
+   * Order of the last IBF segment we sent.
+   */
+  uint16_t ibf_order;
+
+  /**
+   * Number of IBF segments we sent.
+   */
+  unsigned int ibf_segments_sent;
+
+};
+
+
+/**
+ * A key decoded from the difference of the IBFs.
+ */
+struct DecodedKey
+{
+  /**
+   * The IBF key.
+   */
+  struct IBF_Key key;
+
+  /**
+   * 1 if only we have the element, -1 if only the
+   * remote peer has it.
+   */
+  int side;
 };
 
 
@@ -175,7 +268,7 @@ struct OperationState
 struct KeyEntry
 {
   /**
-   * IBF key for the entry, derived from the current salt.
+   * IBF key for the entry, derived from the element hash with salt=0.
    */
   struct IBF_Key ibf_key;
 
@@ -193,22 +286,42 @@ struct KeyEntry
 
 
 /**
- * Used as a closure for sending elements
+ * Used as a closure for finding the entries
  * with a specific IBF key.
  */
-struct SendElementClosure
+struct FindChainClosure
 {
   /**
-   * The IBF key whose matching elements should be
-   * sent.
+   * The IBF key of interest.
    */
   struct IBF_Key ibf_key;
 
   /**
-   * Operation for which the elements
-   * should be sent.
+   * First entry with that key, NULL if not found.
    */
-  struct Operation *op;
+  struct KeyEntry *chain;
+};
+
+
+/**
+ * Mapping from IBF keys to the elements of a set content.  It is
+ * maintained as elements are added to the set, and shared by all
+ * lazy copies of the set and all their union operations, which
+ * select the elements visible to them by generation.
+ */
+struct KeyIndex
+{
+  /**
+   * Maps IBF-Keys to `struct KeyEntry`s.
+   * Used as a multihashmap, the keys being the lower 32bit of the IBF-Key.
+   * Colliding IBF-Keys are linked.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *key_to_element;
+
+  /**
+   * Number of sets sharing the index.
+   */
+  unsigned int refcount;
 };
 
 
@@ -224,6 +337,11 @@ struct SetState
    * salt=0.
    */
   struct StrataEstimator *se;
+
+  /**
+   * IBF keys of the elements, shared with the set's lazy copies.
+   */
+  struct KeyIndex *index;
 };
 
 
@@ -269,6 +387,8 @@ destroy_key_to_element_iter (void *cls,
 static void
 union_op_cancel (struct Operation *op)
 {
+  unsigned int i;
+
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "destroying union op\n");
   /* check if the op was canceled twice */
@@ -283,19 +403,30 @@ union_op_cancel (struct Operation *op)
     ibf_destroy (op->state->local_ibf);
     op->state->local_ibf = NULL;
   }
+  for (i = 0; i < op->state->num_diff_ibfs; i++)
+    ibf_destroy (op->state->diff_ibfs[i]);
+  GNUNET_array_grow (op->state->diff_ibfs,
+                     op->state->num_diff_ibfs,
+                     0);
+  GNUNET_array_grow (op->state->decoded,
+                     op->state->decoded_size,
+                     0);
   if (NULL != op->state->se)
   {
     strata_estimator_destroy (op->state->se);
     op->state->se = NULL;
   }
-  if (NULL != op->state->key_to_element)
+  if (NULL != op->state->remote_elements)
   {
-    GNUNET_CONTAINER_multihashmap32_iterate (op->state->key_to_element,
+    GNUNET_CONTAINER_multihashmap32_iterate (op->state->remote_elements,
                                              &destroy_key_to_element_iter,
                                              NULL);
-    GNUNET_CONTAINER_multihashmap32_destroy (op->state->key_to_element);
-    op->state->key_to_element = NULL;
+    GNUNET_CONTAINER_multihashmap32_destroy (op->state->remote_elements);
+    op->state->remote_elements = NULL;
   }
+  GNUNET_array_grow (op->state->full_result,
+                     op->state->full_result_size,
+                     0);
   GNUNET_free (op->state);
   op->state = NULL;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -350,216 +481,250 @@ get_ibf_key (const struct GNUNET_HashCode *src,
 
 
 /**
- * Iterator to create the mapping between ibf keys
- * and element entries.
+ * Iterator to find the entries with a given
+ * ibf key in a key-to-element mapping.
  *
- * @param cls closure
+ * @param cls the `struct FindChainClosure`
  * @param key current key code
  * @param value value in the hash map
  * @return #GNUNET_YES if we should continue to iterate,
  *         #GNUNET_NO if not.
  */
 static int
-op_register_element_iterator (void *cls,
-                              uint32_t key,
-                              void *value)
+find_chain_iterator (void *cls,
+                     uint32_t key,
+                     void *value)
 {
-  struct KeyEntry *const new_k = cls;
-  struct KeyEntry *old_k = value;
+  struct FindChainClosure *fcc = cls;
+  struct KeyEntry *ke = value;
 
-  GNUNET_assert (NULL != old_k);
-  /* check if our ibf key collides with the ibf key in the existing entry */
-  if (old_k->ibf_key.key_val == new_k->ibf_key.key_val)
-  {
-    /* insert the the new key in the collision chain */
-    new_k->next_colliding = old_k->next_colliding;
-    old_k->next_colliding = new_k;
-    /* signal to the caller that we were able to insert into a colliding bucket */
-    return GNUNET_NO;
-  }
-  return GNUNET_YES;
+  if (ke->ibf_key.key_val != fcc->ibf_key.key_val)
+    return GNUNET_YES;
+  fcc->chain = ke;
+  return GNUNET_NO;
 }
 
 
 /**
- * Iterator to create the mapping between ibf keys
- * and element entries.
+ * Get the entries with the given ibf key
+ * from a key-to-element mapping.
  *
- * @param cls closure
- * @param key current key code
- * @param value value in the hash map
- * @return #GNUNET_YES (we should continue to iterate)
+ * @param key_to_element the mapping
+ * @param ibf_key the ibf key
+ * @return first entry with the key, linked to the others
+ *         via `next_colliding`; NULL if there is none
  */
-static int
-op_has_element_iterator (void *cls,
-                         uint32_t key,
-                         void *value)
+static struct KeyEntry *
+key_map_get_chain (struct GNUNET_CONTAINER_MultiHashMap32 *key_to_element,
+                   struct IBF_Key ibf_key)
 {
-  struct GNUNET_HashCode *element_hash = cls;
-  struct KeyEntry *k = value;
+  struct FindChainClosure fcc;
 
-  GNUNET_assert (NULL != k);
-  while (NULL != k)
-  {
-    if (0 == GNUNET_CRYPTO_hash_cmp (&k->element->element_hash,
-                                     element_hash))
-      return GNUNET_NO;
-    k = k->next_colliding;
-  }
-  return GNUNET_YES;
+  fcc.ibf_key = ibf_key;
+  fcc.chain = NULL;
+  (void) GNUNET_CONTAINER_multihashmap32_get_multiple (key_to_element,
+                                                       (uint32_t) ibf_key.key_val,
+                                                       &find_chain_iterator,
+                                                       &fcc);
+  return fcc.chain;
 }
 
 
 /**
- * Determine whether the given element is already in the operation's element
- * set.
+ * Insert an element into a key-to-element mapping,
+ * unless it is already there.
  *
- * @param op operation that should be tested for 'element_hash'
- * @param element_hash hash of the element to look for
- * @return #GNUNET_YES if the element has been found, #GNUNET_NO otherwise
+ * @param key_to_element the mapping
+ * @param ee the element entry
+ * @param ibf_key the element's ibf key
  */
-static int
-op_has_element (struct Operation *op,
-                const struct GNUNET_HashCode *element_hash)
+static void
+key_map_insert (struct GNUNET_CONTAINER_MultiHashMap32 *key_to_element,
+                struct ElementEntry *ee,
+                struct IBF_Key ibf_key)
 {
-  int ret;
-  struct IBF_Key ibf_key;
-
-  ibf_key = get_ibf_key (element_hash, op->spec->salt);
-  ret = GNUNET_CONTAINER_multihashmap32_get_multiple (op->state->key_to_element,
-                                                      (uint32_t) ibf_key.key_val,
-                                                      op_has_element_iterator,
-                                                      (void *) element_hash);
+  struct KeyEntry *chain;
+  struct KeyEntry *k;
 
-  /* was the iteration aborted because we found the element? */
-  if (GNUNET_SYSERR == ret)
-    return GNUNET_YES;
-  return GNUNET_NO;
+  chain = key_map_get_chain (key_to_element, ibf_key);
+  for (k = chain; NULL != k; k = k->next_colliding)
+    if (k->element == ee)
+      return;
+  k = GNUNET_new (struct KeyEntry);
+  k->element = ee;
+  k->ibf_key = ibf_key;
+  if (NULL != chain)
+  {
+    /* insert the the new key in the collision chain */
+    k->next_colliding = chain->next_colliding;
+    chain->next_colliding = k;
+    return;
+  }
+  GNUNET_CONTAINER_multihashmap32_put (key_to_element,
+                                       (uint32_t) ibf_key.key_val,
+                                       k,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
 }
 
 
 /**
- * Insert an element into the union operation's
- * key-to-element mapping. Takes ownership of 'ee'.
- * Note that this does not insert the element in the set,
- * only in the operation's key-element mapping.
- * This is done to speed up re-tried operations, if some elements
- * were transmitted, and then the IBF fails to decode.
+ * Remove an element from a key-to-element mapping.
  *
- * @param op the union operation
+ * @param key_to_element the mapping
  * @param ee the element entry
+ * @param ibf_key the element's ibf key
  */
 static void
-op_register_element (struct Operation *op,
-                     struct ElementEntry *ee)
+key_map_remove (struct GNUNET_CONTAINER_MultiHashMap32 *key_to_element,
+                struct ElementEntry *ee,
+                struct IBF_Key ibf_key)
 {
-  int ret;
-  struct IBF_Key ibf_key;
+  struct KeyEntry *chain;
+  struct KeyEntry *prev;
   struct KeyEntry *k;
 
-  ibf_key = get_ibf_key (&ee->element_hash, op->spec->salt);
-  k = GNUNET_new (struct KeyEntry);
-  k->element = ee;
-  k->ibf_key = ibf_key;
-  ret = GNUNET_CONTAINER_multihashmap32_get_multiple (op->state->key_to_element,
-                                                      (uint32_t) ibf_key.key_val,
-                                                      op_register_element_iterator,
-                                                      k);
-
-  /* was the element inserted into a colliding bucket? */
-  if (GNUNET_SYSERR == ret)
+  chain = key_map_get_chain (key_to_element, ibf_key);
+  prev = NULL;
+  for (k = chain; NULL != k; k = k->next_colliding)
+  {
+    if (k->element == ee)
+      break;
+    prev = k;
+  }
+  if (NULL == k)
     return;
-  GNUNET_CONTAINER_multihashmap32_put (op->state->key_to_element,
-                                       (uint32_t) ibf_key.key_val,
-                                       k,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  if (NULL != prev)
+  {
+    prev->next_colliding = k->next_colliding;
+    GNUNET_free (k);
+    return;
+  }
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap32_remove (key_to_element,
+                                                         (uint32_t) ibf_key.key_val,
+                                                         k));
+  if (NULL != k->next_colliding)
+    GNUNET_CONTAINER_multihashmap32_put (key_to_element,
+                                         (uint32_t) ibf_key.key_val,
+                                         k->next_colliding,
+                                         GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  GNUNET_free (k);
 }
 
 
 /**
- * Insert a key into an ibf.
+ * Determine whether the given element is already in the operation's element
+ * set, either as one of our elements or as one received from the remote peer.
  *
- * @param cls the ibf
- * @param key unused
- * @param value the key entry to get the key from
+ * @param op operation that should be tested for 'element_hash'
+ * @param element_hash hash of the element to look for
+ * @param ibf_key ibf key of the element
+ * @return #GNUNET_YES if the element has been found, #GNUNET_NO otherwise
  */
 static int
-prepare_ibf_iterator (void *cls,
-                      uint32_t key,
-                      void *value)
+op_has_element (struct Operation *op,
+                const struct GNUNET_HashCode *element_hash,
+                struct IBF_Key ibf_key)
 {
-  struct InvertibleBloomFilter *ibf = cls;
-  struct KeyEntry *ke = value;
+  struct KeyEntry *k;
 
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "inserting %x into ibf\n",
-              ke->ibf_key.key_val);
-  ibf_insert (ibf, ke->ibf_key);
-  return GNUNET_YES;
+  for (k = key_map_get_chain (op->spec->set->state->index->key_to_element,
+                              ibf_key);
+       NULL != k;
+       k = k->next_colliding)
+    if ( (0 == GNUNET_CRYPTO_hash_cmp (&k->element->element_hash,
+                                       element_hash)) &&
+         (GNUNET_YES == _GSS_is_element_of_operation (k->element, op)) )
+      return GNUNET_YES;
+  for (k = key_map_get_chain (op->state->remote_elements,
+                              ibf_key);
+       NULL != k;
+       k = k->next_colliding)
+    if (0 == GNUNET_CRYPTO_hash_cmp (&k->element->element_hash,
+                                     element_hash))
+      return GNUNET_YES;
+  return GNUNET_NO;
 }
 
 
 /**
- * Iterator for initializing the
- * key-to-element mapping of a union operation
+ * Insert a key into the local ibf of an operation, if any of
+ * the elements with the key belong to the operation's set.
  *
- * @param cls the union operation `struct Operation *`
+ * @param cls the union operation
  * @param key unused
- * @param value the `struct ElementEntry *` to insert
- *        into the key-to-element mapping
+ * @param value the key entry to get the key from
  * @return #GNUNET_YES (to continue iterating)
  */
 static int
-init_key_to_element_iterator (void *cls,
-                              const struct GNUNET_HashCode *key,
-                              void *value)
+prepare_ibf_iterator (void *cls,
+                      uint32_t key,
+                      void *value)
 {
   struct Operation *op = cls;
-  struct ElementEntry *ee = value;
+  struct KeyEntry *ke;
 
-  /* make sure that the element belongs to the set at the time
-   * of creating the operation */
-  if (GNUNET_NO == _GSS_is_element_of_operation (ee, op))
+  /* colliding entries share the ibf key, which is inserted once */
+  for (ke = value; NULL != ke; ke = ke->next_colliding)
+    if (GNUNET_YES == _GSS_is_element_of_operation (ke->element, op))
+      break;
+  if (NULL == ke)
     return GNUNET_YES;
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "inserting %llx into ibf\n",
+              (unsigned long long) ke->ibf_key.key_val);
+  ibf_insert (op->state->local_ibf, ke->ibf_key);
+  return GNUNET_YES;
+}
 
-  GNUNET_assert (GNUNET_NO == ee->remote);
 
-  op_register_element (op, ee);
-  return GNUNET_YES;
+/**
+ * Forget the IBF segments received so far and the keys decoded
+ * from them, the remote peer starts over with a new IBF.
+ *
+ * @param state state of the union operation
+ */
+static void
+reset_diff_ibfs (struct OperationState *state)
+{
+  unsigned int i;
+
+  for (i = 0; i < state->num_diff_ibfs; i++)
+    ibf_destroy (state->diff_ibfs[i]);
+  GNUNET_array_grow (state->diff_ibfs,
+                     state->num_diff_ibfs,
+                     0);
+  state->num_decoded = 0;
 }
 
 
 /**
  * Create an ibf with the operation's elements
- * of the specified size
+ * of the specified size.  Elements received from the remote peer
+ * are not included, so that all IBF segments of an operation
+ * reflect the same set.
  *
  * @param op the union operation
  * @param size size of the ibf to create
+ * @param salt salt of the ibf (index of the segment)
  */
 static void
 prepare_ibf (struct Operation *op,
-             uint16_t size)
+             uint32_t size,
+             uint32_t salt)
 {
-  if (NULL == op->state->key_to_element)
-  {
-    unsigned int len;
-
-    len = GNUNET_CONTAINER_multihashmap_size (op->spec->set->content->elements);
-    op->state->key_to_element = GNUNET_CONTAINER_multihashmap32_create (len + 1);
-    GNUNET_CONTAINER_multihashmap_iterate (op->spec->set->content->elements,
-                                           init_key_to_element_iterator, op);
-  }
   if (NULL != op->state->local_ibf)
     ibf_destroy (op->state->local_ibf);
   op->state->local_ibf = ibf_create (size, SE_IBF_HASH_NUM);
-  GNUNET_CONTAINER_multihashmap32_iterate (op->state->key_to_element,
+  op->state->local_ibf->salt = salt;
+  GNUNET_CONTAINER_multihashmap32_iterate (op->spec->set->state->index->key_to_element,
                                            &prepare_ibf_iterator,
-                                           op->state->local_ibf);
+                                           op);
 }
 
 
 /**
- * Send an ibf of appropriate size.
+ * Send the next ibf segment, of appropriate size.
  *
  * @param op the union operation
  * @param ibf_order order of the ibf to send, size=2^order
@@ -569,12 +734,19 @@ send_ibf (struct Operation *op,
           uint16_t ibf_order)
 {
   unsigned int buckets_sent = 0;
+  uint32_t salt = op->state->ibf_segments_sent++;
   struct InvertibleBloomFilter *ibf;
 
-  prepare_ibf (op, 1<<ibf_order);
+  op->state->ibf_order = ibf_order;
+  prepare_ibf (op, 1<<ibf_order, salt);
+  GNUNET_STATISTICS_update (_GSS_statistics,
+                            "# union IBF segments sent",
+                            1,
+                            GNUNET_NO);
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "sending ibf of size %u\n",
+              "sending ibf segment %u of size %u\n",
+              salt,
               1<<ibf_order);
 
   ibf = op->state->local_ibf;
@@ -593,9 +765,10 @@ send_ibf (struct Operation *op,
     ev = GNUNET_MQ_msg_extra (msg,
                               buckets_in_message * IBF_BUCKET_SIZE,
                               GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF);
-    msg->reserved = 0;
+    msg->flags = IBF_FLAG_MORE_SEGMENTS;
     msg->order = ibf_order;
     msg->offset = htons (buckets_sent);
+    msg->salt = htonl (salt);
     ibf_write_slice (ibf, buckets_sent,
                      buckets_in_message, &msg[1]);
     buckets_sent += buckets_in_message;
@@ -707,31 +880,29 @@ handle_p2p_strata_estimator (void *cls,
 
 
 /**
- * Iterator to send elements to a remote peer
+ * Send all of our elements that have the specified IBF key
+ * to the remote peer of the union operation
  *
- * @param cls closure with the element key and the union operation
- * @param key ignored
- * @param value the key entry
+ * @param op union operation
+ * @param ibf_key IBF key of interest
  */
-static int
-send_element_iterator (void *cls,
-                       uint32_t key,
-                       void *value)
+static void
+send_elements_for_key (struct Operation *op,
+                       struct IBF_Key ibf_key)
 {
-  struct SendElementClosure *sec = cls;
-  struct IBF_Key ibf_key = sec->ibf_key;
-  struct Operation *op = sec->op;
-  struct KeyEntry *ke = value;
+  struct KeyEntry *ke;
 
-  if (ke->ibf_key.key_val != ibf_key.key_val)
-    return GNUNET_YES;
-  while (NULL != ke)
+  for (ke = key_map_get_chain (op->spec->set->state->index->key_to_element,
+                               ibf_key);
+       NULL != ke;
+       ke = ke->next_colliding)
   {
     const struct GNUNET_SET_Element *const element = &ke->element->element;
     struct GNUNET_MQ_Envelope *ev;
     struct GNUNET_MessageHeader *mh;
 
-    GNUNET_assert (ke->ibf_key.key_val == ibf_key.key_val);
+    if (GNUNET_NO == _GSS_is_element_of_operation (ke->element, op))
+      continue;
     ev = GNUNET_MQ_msg_header_extra (mh,
                                      element->size,
                                      GNUNET_MESSAGE_TYPE_SET_P2P_ELEMENTS);
@@ -748,63 +919,81 @@ send_element_iterator (void *cls,
                 "sending element (%s) to peer\n",
                 GNUNET_h2s (&ke->element->element_hash));
     GNUNET_MQ_send (op->mq, ev);
-    ke = ke->next_colliding;
   }
-  return GNUNET_NO;
 }
 
 
 /**
- * Send all elements that have the specified IBF key
- * to the remote peer of the union operation
+ * Remove a key that was decoded earlier from a difference IBF.
  *
- * @param op union operation
- * @param ibf_key IBF key of interest
+ * @param diff_ibf difference IBF
+ * @param dk the decoded key
  */
 static void
-send_elements_for_key (struct Operation *op,
-                       struct IBF_Key ibf_key)
+remove_decoded_key (struct InvertibleBloomFilter *diff_ibf,
+                    const struct DecodedKey *dk)
 {
-  struct SendElementClosure send_cls;
-
-  send_cls.ibf_key = ibf_key;
-  send_cls.op = op;
-  (void) GNUNET_CONTAINER_multihashmap32_get_multiple (op->state->key_to_element,
-                                                       (uint32_t) ibf_key.key_val,
-                                                       &send_element_iterator,
-                                                       &send_cls);
+  if (1 == dk->side)
+    ibf_remove (diff_ibf, dk->key);
+  else
+    ibf_insert (diff_ibf, dk->key);
 }
 
 
 /**
  * Decode which elements are missing on each side, and
- * send the appropriate elemens and requests
+ * send the appropriate elemens and requests.
+ *
+ * The difference to the IBF segment just received is decoded
+ * together with the (partially decoded) differences to all earlier
+ * segments: a key decoded from one segment is removed from all
+ * others, which may make further buckets pure.  If decoding gets
+ * stuck, we ask the remote peer for another segment instead of
+ * starting over, provided it announced to support that.  Otherwise
+ * (or if decoding cycles) we send a larger IBF ourselves, as older
+ * peers expect.
  *
  * @param op union operation
  */
 static void
 decode_and_send (struct Operation *op)
 {
+  struct OperationState *state = op->state;
   struct IBF_Key key;
   struct IBF_Key last_key;
   int side;
-  unsigned int num_decoded;
+  unsigned int i;
+  unsigned int j;
+  unsigned int total_size;
   struct InvertibleBloomFilter *diff_ibf;
 
-  GNUNET_assert (PHASE_EXPECT_ELEMENTS == op->state->phase);
+  GNUNET_assert (PHASE_EXPECT_ELEMENTS == state->phase);
+
+  prepare_ibf (op,
+               state->remote_ibf->size,
+               state->remote_ibf->salt);
+  diff_ibf = ibf_dup (state->local_ibf);
+  ibf_subtract (diff_ibf, state->remote_ibf);
 
-  prepare_ibf (op, op->state->remote_ibf->size);
-  diff_ibf = ibf_dup (op->state->local_ibf);
-  ibf_subtract (diff_ibf, op->state->remote_ibf);
+  ibf_destroy (state->remote_ibf);
+  state->remote_ibf = NULL;
 
-  ibf_destroy (op->state->remote_ibf);
-  op->state->remote_ibf = NULL;
+  /* we already know the keys decoded from the earlier segments */
+  for (i = 0; i < state->num_decoded; i++)
+    remove_decoded_key (diff_ibf, &state->decoded[i]);
+  GNUNET_array_append (state->diff_ibfs,
+                       state->num_diff_ibfs,
+                       diff_ibf);
+  total_size = 0;
+  for (i = 0; i < state->num_diff_ibfs; i++)
+    total_size += state->diff_ibfs[i]->size;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "decoding IBF (size=%u)\n",
-              diff_ibf->size);
+              "decoding IBF (size=%u, %u segments)\n",
+              diff_ibf->size,
+              state->num_diff_ibfs);
 
-  num_decoded = 0;
+  key.key_val = 0;
   last_key.key_val = 0;
 
   while (1)
@@ -814,43 +1003,73 @@ decode_and_send (struct Operation *op)
 
     last_key = key;
 
-    res = ibf_decode (diff_ibf, &side, &key);
+    res = GNUNET_NO;
+    for (i = 0; i < state->num_diff_ibfs; i++)
+    {
+      int seg_res;
+
+      seg_res = ibf_decode (state->diff_ibfs[i], &side, &key);
+      if (GNUNET_YES == seg_res)
+      {
+        res = GNUNET_YES;
+        break;
+      }
+      if (GNUNET_SYSERR == seg_res)
+        res = GNUNET_SYSERR;
+    }
     if (res == GNUNET_OK)
     {
       GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                  "decoded ibf key %lx\n",
-                  key.key_val);
-      num_decoded += 1;
-      if ( (num_decoded > diff_ibf->size) ||
-           (num_decoded > 1 && last_key.key_val == key.key_val) )
+                  "decoded ibf key %llx\n",
+                  (unsigned long long) key.key_val);
+      if ( (state->num_decoded >= total_size) ||
+           ( (state->num_decoded > 0) &&
+             (last_key.key_val == key.key_val) ) )
       {
         GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                     "detected cyclic ibf (decoded %u/%u)\n",
-                    num_decoded,
-                    diff_ibf->size);
+                    state->num_decoded,
+                    total_size);
         cycle_detected = GNUNET_YES;
       }
     }
+    if ( (GNUNET_SYSERR == res) &&
+         (GNUNET_NO == cycle_detected) &&
+         (GNUNET_YES == state->remote_ibf_more) &&
+         (state->num_diff_ibfs < MAX_IBF_SEGMENTS) )
+    {
+      struct GNUNET_MQ_Envelope *ev;
+
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "decoding stuck after %u keys, requesting another ibf segment\n",
+                  state->num_decoded);
+      state->ibf_more_requested = GNUNET_YES;
+      ev = GNUNET_MQ_msg_header (GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF_MORE);
+      GNUNET_MQ_send (op->mq, ev);
+      break;
+    }
     if ( (GNUNET_SYSERR == res) ||
          (GNUNET_YES == cycle_detected) )
     {
       int next_order;
+
       next_order = 0;
       while (1<<next_order < diff_ibf->size)
         next_order++;
       next_order++;
-      if (next_order <= MAX_IBF_ORDER)
-      {
-        GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		    "decoding failed, sending larger ibf (size %u)\n",
-                    1<<next_order);
-        send_ibf (op, next_order);
-      }
-      else
+      if (next_order > MAX_IBF_ORDER)
       {
         GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
-		    "set union failed: reached ibf limit\n");
+                    "set union failed: reached ibf limit\n");
+        fail_union_operation (op);
+        return;
       }
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "decoding failed, sending larger ibf (size %u)\n",
+                  1<<next_order);
+      reset_diff_ibfs (state);
+      state->ibf_segments_sent = 0;
+      send_ibf (op, next_order);
       break;
     }
     if (GNUNET_NO == res)
@@ -863,6 +1082,18 @@ decode_and_send (struct Operation *op)
       GNUNET_MQ_send (op->mq, ev);
       break;
     }
+    /* remember the key for later segments, and peel it off the others */
+    if (state->num_decoded == state->decoded_size)
+      GNUNET_array_grow (state->decoded,
+                         state->decoded_size,
+                         GNUNET_MAX (16, 2 * state->decoded_size));
+    state->decoded[state->num_decoded].key = key;
+    state->decoded[state->num_decoded].side = side;
+    for (j = 0; j < state->num_diff_ibfs; j++)
+      if (j != i)
+        remove_decoded_key (state->diff_ibfs[j],
+                            &state->decoded[state->num_decoded]);
+    state->num_decoded++;
     if (1 == side)
     {
       send_elements_for_key (op, key);
@@ -890,7 +1121,6 @@ decode_and_send (struct Operation *op)
       GNUNET_assert (0);
     }
   }
-  ibf_destroy (diff_ibf);
 }
 
 
@@ -917,15 +1147,42 @@ handle_p2p_ibf (void *cls,
     return GNUNET_SYSERR;
   }
   msg = (const struct IBFMessage *) mh;
-  if ( (op->state->phase == PHASE_EXPECT_ELEMENTS_AND_REQUESTS) ||
-       (op->state->phase == PHASE_EXPECT_IBF) )
+  if (msg->order > MAX_IBF_ORDER)
+  {
+    GNUNET_break_op (0);
+    fail_union_operation (op);
+    return GNUNET_SYSERR;
+  }
+  if (NULL == op->state->remote_ibf)
   {
-    op->state->phase = PHASE_EXPECT_IBF_CONT;
-    GNUNET_assert (NULL == op->state->remote_ibf);
+    if ( (0 == ntohl (msg->salt)) &&
+         ( (op->state->phase == PHASE_EXPECT_IBF) ||
+           (op->state->phase == PHASE_EXPECT_ELEMENTS_AND_REQUESTS) ) )
+    {
+      /* a new IBF; after a failed decoding, the peers swap roles */
+      op->state->phase = PHASE_EXPECT_IBF_CONT;
+      reset_diff_ibfs (op->state);
+    }
+    else if ( (ntohl (msg->salt) == op->state->num_diff_ibfs) &&
+              (op->state->phase == PHASE_EXPECT_ELEMENTS) &&
+              (GNUNET_YES == op->state->ibf_more_requested) )
+    {
+      /* the next segment of the current IBF */
+      op->state->ibf_more_requested = GNUNET_NO;
+    }
+    else
+    {
+      GNUNET_break_op (0);
+      fail_union_operation (op);
+      return GNUNET_SYSERR;
+    }
+    op->state->remote_ibf_more
+      = (0 != (msg->flags & IBF_FLAG_MORE_SEGMENTS)) ? GNUNET_YES : GNUNET_NO;
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Creating new ibf of size %u\n",
                 1 << msg->order);
     op->state->remote_ibf = ibf_create (1<<msg->order, SE_IBF_HASH_NUM);
+    op->state->remote_ibf->salt = ntohl (msg->salt);
     op->state->ibf_buckets_received = 0;
     if (0 != ntohs (msg->offset))
     {
@@ -934,7 +1191,8 @@ handle_p2p_ibf (void *cls,
       return GNUNET_SYSERR;
     }
   }
-  else if (op->state->phase == PHASE_EXPECT_IBF_CONT)
+  else if ( (op->state->phase == PHASE_EXPECT_IBF_CONT) ||
+            (op->state->phase == PHASE_EXPECT_ELEMENTS) )
   {
     if ( (ntohs (msg->offset) != op->state->ibf_buckets_received) ||
          (1<<msg->order != op->state->remote_ibf->size) )
@@ -944,10 +1202,18 @@ handle_p2p_ibf (void *cls,
       return GNUNET_SYSERR;
     }
   }
+  else
+  {
+    GNUNET_break_op (0);
+    fail_union_operation (op);
+    return GNUNET_SYSERR;
+  }
 
   buckets_in_message = (ntohs (msg->header.size) - sizeof *msg) / IBF_BUCKET_SIZE;
 
-  if (0 == buckets_in_message)
+  if ( (0 == buckets_in_message) ||
+       (buckets_in_message >
+        op->state->remote_ibf->size - op->state->ibf_buckets_received) )
   {
     GNUNET_break_op (0);
     fail_union_operation (op);
@@ -978,6 +1244,35 @@ handle_p2p_ibf (void *cls,
 }
 
 
+/**
+ * Handle a request for another IBF segment from a remote peer.
+ * The new segment is twice as large as the previous one.
+ *
+ * @param cls the union operation
+ * @param mh the message
+ * @return #GNUNET_SYSERR if the tunnel should be disconnected,
+ *         #GNUNET_OK otherwise
+ */
+static int
+handle_p2p_ibf_more (void *cls,
+                     const struct GNUNET_MessageHeader *mh)
+{
+  struct Operation *op = cls;
+
+  if ( (op->state->phase != PHASE_EXPECT_ELEMENTS_AND_REQUESTS) ||
+       (op->state->ibf_segments_sent >= MAX_IBF_SEGMENTS) )
+  {
+    GNUNET_break_op (0);
+    fail_union_operation (op);
+    return GNUNET_SYSERR;
+  }
+  send_ibf (op,
+            GNUNET_MIN (op->state->ibf_order + 1,
+                        MAX_IBF_ORDER));
+  return GNUNET_OK;
+}
+
+
 /**
  * Send a result message to the client indicating
  * that there is a new element.
@@ -1037,7 +1332,7 @@ send_done_and_destroy (void *cls)
 
 
 /**
- * Send all remaining elements in the full result iterator.
+ * Send all remaining elements of the full result, one at a time.
  *
  * @param cls operation
  */
@@ -1045,28 +1340,14 @@ static void
 send_remaining_elements (void *cls)
 {
   struct Operation *op = cls;
-  struct KeyEntry *ke;
-  int res;
 
-  res = GNUNET_CONTAINER_multihashmap32_iterator_next (op->state->full_result_iter,
-                                                       NULL,
-                                                       (const void **) &ke);
-  if (GNUNET_NO == res)
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "sending done and destroy because iterator ran out\n");
-    send_done_and_destroy (op);
-    return;
-  }
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "sending elements from key entry\n");
-  while (1)
+  while (op->state->full_result_pos < op->state->full_result_len)
   {
     struct GNUNET_MQ_Envelope *ev;
     struct GNUNET_SET_ResultMessage *rm;
-    struct GNUNET_SET_Element *element;
+    const struct GNUNET_SET_Element *element;
 
-    element = &ke->element->element;
+    element = &op->state->full_result[op->state->full_result_pos++]->element;
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "sending element (size %u) to client (full set)\n",
                 element->size);
@@ -1076,7 +1357,6 @@ send_remaining_elements (void *cls)
                               GNUNET_MESSAGE_TYPE_SET_RESULT);
     if (NULL == ev)
     {
-      GNUNET_MQ_discard (ev);
       GNUNET_break (0);
       continue;
     }
@@ -1084,15 +1364,45 @@ send_remaining_elements (void *cls)
     rm->request_id = htonl (op->spec->client_request_id);
     rm->element_type = element->element_type;
     memcpy (&rm[1], element->data, element->size);
-    if (NULL == ke->next_colliding)
-    {
-      GNUNET_MQ_notify_sent (ev, send_remaining_elements, op);
-      GNUNET_MQ_send (op->spec->set->client_mq, ev);
-      break;
-    }
+    GNUNET_MQ_notify_sent (ev, send_remaining_elements, op);
     GNUNET_MQ_send (op->spec->set->client_mq, ev);
-    ke = ke->next_colliding;
+    return;
   }
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "sending done and destroy because iterator ran out\n");
+  send_done_and_destroy (op);
+}
+
+
+/**
+ * Add the elements of a key entry chain that belong to
+ * the result of an operation to its full result.
+ *
+ * @param cls the union operation
+ * @param key unused
+ * @param value the key entry
+ * @return #GNUNET_YES (to continue iterating)
+ */
+static int
+collect_full_result_iterator (void *cls,
+                              uint32_t key,
+                              void *value)
+{
+  struct Operation *op = cls;
+  struct KeyEntry *ke;
+
+  for (ke = value; NULL != ke; ke = ke->next_colliding)
+  {
+    if ( (GNUNET_NO == ke->element->remote) &&
+         (GNUNET_NO == _GSS_is_element_of_operation (ke->element, op)) )
+      continue;
+    if (op->state->full_result_len == op->state->full_result_size)
+      GNUNET_array_grow (op->state->full_result,
+                         op->state->full_result_size,
+                         GNUNET_MAX (16, 2 * op->state->full_result_size));
+    op->state->full_result[op->state->full_result_len++] = ke->element;
+  }
+  return GNUNET_YES;
 }
 
 
@@ -1114,9 +1424,14 @@ finish_and_destroy (struct Operation *op)
     /* prevent that the op is free'd by the tunnel end handler */
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "sending full result set\n");
-    GNUNET_assert (NULL == op->state->full_result_iter);
-    op->state->full_result_iter =
-        GNUNET_CONTAINER_multihashmap32_iterator_create (op->state->key_to_element);
+    /* take a snapshot, the set may change while we send */
+    GNUNET_assert (0 == op->state->full_result_len);
+    GNUNET_CONTAINER_multihashmap32_iterate (op->spec->set->state->index->key_to_element,
+                                             &collect_full_result_iterator,
+                                             op);
+    GNUNET_CONTAINER_multihashmap32_iterate (op->state->remote_elements,
+                                             &collect_full_result_iterator,
+                                             op);
     send_remaining_elements (op);
     return;
   }
@@ -1136,6 +1451,7 @@ handle_p2p_elements (void *cls,
 {
   struct Operation *op = cls;
   struct ElementEntry *ee;
+  struct IBF_Key ibf_key;
   uint16_t element_size;
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1157,7 +1473,8 @@ handle_p2p_elements (void *cls,
                       ee->element.size,
                       &ee->element_hash);
 
-  if (GNUNET_YES == op_has_element (op, &ee->element_hash))
+  ibf_key = get_ibf_key (&ee->element_hash, 0);
+  if (GNUNET_YES == op_has_element (op, &ee->element_hash, ibf_key))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "got existing element from peer\n");
@@ -1165,7 +1482,7 @@ handle_p2p_elements (void *cls,
     return;
   }
 
-  op_register_element (op, ee);
+  key_map_insert (op->state->remote_elements, ee, ibf_key);
   /* only send results immediately if the client wants it */
   if (GNUNET_SET_RESULT_ADDED == op->spec->result_mode)
     send_client_element (op, &ee->element);
@@ -1266,6 +1583,7 @@ union_evaluate (struct Operation *op,
   op->state = GNUNET_new (struct OperationState);
   /* copy the current generation's strata estimator for this operation */
   op->state->se = strata_estimator_dup (op->spec->set->state->se);
+  op->state->remote_elements = GNUNET_CONTAINER_multihashmap32_create (32);
   /* we started the operation, thus we have to send the operation request */
   op->state->phase = PHASE_EXPECT_SE;
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -1307,6 +1625,7 @@ union_accept (struct Operation *op)
               "accepting set union operation\n");
   op->state = GNUNET_new (struct OperationState);
   op->state->se = strata_estimator_dup (op->spec->set->state->se);
+  op->state->remote_elements = GNUNET_CONTAINER_multihashmap32_create (32);
   /* kick off the operation */
   send_strata_estimator (op);
 }
@@ -1330,6 +1649,9 @@ union_set_create (void)
   set_state = GNUNET_new (struct SetState);
   set_state->se = strata_estimator_create (SE_STRATA_COUNT,
                                            SE_IBF_SIZE, SE_IBF_HASH_NUM);
+  set_state->index = GNUNET_new (struct KeyIndex);
+  set_state->index->key_to_element = GNUNET_CONTAINER_multihashmap32_create (32);
+  set_state->index->refcount = 1;
   return set_state;
 }
 
@@ -1343,8 +1665,14 @@ union_set_create (void)
 static void
 union_add (struct SetState *set_state, struct ElementEntry *ee)
 {
+  struct IBF_Key ibf_key;
+
+  ibf_key = get_ibf_key (&ee->element_hash, 0);
   strata_estimator_insert (set_state->se,
-                           get_ibf_key (&ee->element_hash, 0));
+                           ibf_key);
+  key_map_insert (set_state->index->key_to_element,
+                  ee,
+                  ibf_key);
 }
 
 
@@ -1358,8 +1686,18 @@ union_add (struct SetState *set_state, struct ElementEntry *ee)
 static void
 union_remove (struct SetState *set_state, struct ElementEntry *ee)
 {
+  struct IBF_Key ibf_key;
+
+  ibf_key = get_ibf_key (&ee->element_hash, 0);
   strata_estimator_remove (set_state->se,
-                           get_ibf_key (&ee->element_hash, 0));
+                           ibf_key);
+  /* Without mutations, the element was dropped from the set content
+   * right away, as no operation or lazy copy can see it any more.
+   * Otherwise, operations select the element by generation. */
+  if (NULL == ee->mutations)
+    key_map_remove (set_state->index->key_to_element,
+                    ee,
+                    ibf_key);
 }
 
 
@@ -1376,6 +1714,16 @@ union_set_destroy (struct SetState *set_state)
     strata_estimator_destroy (set_state->se);
     set_state->se = NULL;
   }
+  GNUNET_assert (0 < set_state->index->refcount);
+  set_state->index->refcount--;
+  if (0 == set_state->index->refcount)
+  {
+    GNUNET_CONTAINER_multihashmap32_iterate (set_state->index->key_to_element,
+                                             &destroy_key_to_element_iter,
+                                             NULL);
+    GNUNET_CONTAINER_multihashmap32_destroy (set_state->index->key_to_element);
+    GNUNET_free (set_state->index);
+  }
   GNUNET_free (set_state);
 }
 
@@ -1400,6 +1748,8 @@ union_handle_p2p_message (struct Operation *op,
   {
     case GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF:
       return handle_p2p_ibf (op, mh);
+    case GNUNET_MESSAGE_TYPE_SET_UNION_P2P_IBF_MORE:
+      return handle_p2p_ibf_more (op, mh);
     case GNUNET_MESSAGE_TYPE_SET_UNION_P2P_SE:
       return handle_p2p_strata_estimator (op, mh);
     case GNUNET_MESSAGE_TYPE_SET_P2P_ELEMENTS:
@@ -1460,6 +1810,9 @@ union_copy_state (struct Set *set)
   new_state = GNUNET_new (struct SetState);
   GNUNET_assert ( (NULL != set->state) && (NULL != set->state->se) );
   new_state->se = strata_estimator_dup (set->state->se);
+  /* the copy shares the set content, and thus the index */
+  new_state->index = set->state->index;
+  new_state->index->refcount++;
 
   return new_state;
 }
@@ -35,6 +35,16 @@ static unsigned int csize = 10;
 static unsigned int hash_num = 4;
 static unsigned int ibf_size = 80;
 
+/**
+ * Output format, "text", "csv" or "json".
+ */
+static char *format_str = "text";
+
+/**
+ * File to append the result row to, NULL for stdout.
+ */
+static char *output_filename;
+
 /* FIXME: add parameter for this */
 static enum GNUNET_CRYPTO_Quality random_quality = GNUNET_CRYPTO_QUALITY_WEAK;
 
@@ -77,6 +87,99 @@ iter_hashcodes (struct IBF_Key key,
 }
 
 
+/**
+ * Report the result of a run.  In text format, only the outcome is
+ * printed, as the timings have been printed along the way.
+ *
+ * @param result outcome of the decoding, "ok", "failed", "cyclic" or "missed"
+ * @param encode_time time it took to fill both IBFs
+ * @param decode_time time it took to decode the difference
+ */
+static void
+report (const char *result,
+        struct GNUNET_TIME_Relative encode_time,
+        struct GNUNET_TIME_Relative decode_time)
+{
+  FILE *f;
+  unsigned int left;
+  unsigned long long peak_rss;
+
+  left = GNUNET_CONTAINER_multihashmap_size (set_a) +
+    GNUNET_CONTAINER_multihashmap_size (set_b);
+  peak_rss = 0;
+#if HAVE_GETRUSAGE
+  {
+    struct rusage ru;
+
+    if (0 == getrusage (RUSAGE_SELF, &ru))
+      peak_rss = ru.ru_maxrss;
+  }
+#endif
+  if (0 == strcasecmp (format_str, "text"))
+  {
+    if (0 == strcmp (result, "ok"))
+      printf ("decoded successfully in: %s\n",
+              GNUNET_STRINGS_relative_time_to_string (decode_time,
+                                                      GNUNET_NO));
+    else if (0 == strcmp (result, "missed"))
+      printf ("decode missed elements (should never happen)\n");
+    else
+      printf ("%s, %u/%u elements left\n",
+              (0 == strcmp (result, "cyclic")) ? "cyclic IBF" : "decode failed",
+              left,
+              asize + bsize);
+    return;
+  }
+  f = stdout;
+  if (NULL != output_filename)
+  {
+    f = fopen (output_filename, "a");
+    if (NULL == f)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "fopen",
+                                output_filename);
+      return;
+    }
+  }
+  if (0 == strcasecmp (format_str, "csv"))
+  {
+    /* only write the header once per file */
+    if ( (stdout == f) ||
+         ( (0 == fseek (f, 0, SEEK_END)) &&
+           (0 == ftell (f)) ) )
+      fprintf (f,
+               "hash_num,ibf_size,asize,bsize,csize,ibf_bytes,result,"
+               "elements_left,encode_us,decode_us,peak_rss_kib\n");
+    fprintf (f, "%u,%u,%u,%u,%u,%llu,%s,%u,%llu,%llu,%llu\n",
+             hash_num, ibf_size, asize, bsize, csize,
+             (unsigned long long) ibf_size * IBF_BUCKET_SIZE,
+             result, left,
+             (unsigned long long) encode_time.rel_value_us,
+             (unsigned long long) decode_time.rel_value_us,
+             peak_rss);
+  }
+  else
+  {
+    /* one object per line, so that runs can be appended */
+    fprintf (f,
+             "{\"hash_num\": %u, \"ibf_size\": %u, \"asize\": %u, "
+             "\"bsize\": %u, \"csize\": %u, \"ibf_bytes\": %llu, "
+             "\"result\": \"%s\", \"elements_left\": %u, "
+             "\"encode_us\": %llu, \"decode_us\": %llu, "
+             "\"peak_rss_kib\": %llu}\n",
+             hash_num, ibf_size, asize, bsize, csize,
+             (unsigned long long) ibf_size * IBF_BUCKET_SIZE,
+             result, left,
+             (unsigned long long) encode_time.rel_value_us,
+             (unsigned long long) decode_time.rel_value_us,
+             peak_rss);
+  }
+  if (stdout != f)
+    GNUNET_break (0 == fclose (f));
+}
+
+
 static int
 insert_iterator (void *cls,
                  const struct GNUNET_HashCode *key,
@@ -112,6 +215,17 @@ run (void *cls, char *const *args, const char *cfgfile,
   int res;
   struct GNUNET_TIME_Absolute start_time;
   struct GNUNET_TIME_Relative delta_time;
+  struct GNUNET_TIME_Relative encode_time;
+  int text;
+
+  text = (0 == strcasecmp (format_str, "text"));
+  if ( (GNUNET_YES != text) &&
+       (0 != strcasecmp (format_str, "csv")) &&
+       (0 != strcasecmp (format_str, "json")) )
+  {
+    fprintf (stderr, "unknown output format `%s'\n", format_str);
+    return;
+  }
 
   set_a = GNUNET_CONTAINER_multihashmap_create (((asize == 0) ? 1 : (asize + csize)),
                                                  GNUNET_NO);
@@ -123,8 +237,9 @@ run (void *cls, char *const *args, const char *cfgfile,
   key_to_hashcode = GNUNET_CONTAINER_multihashmap_create (((asize+bsize+csize == 0) ? 1 : (asize+bsize+csize)),
                                                           GNUNET_NO);
 
-  printf ("hash-num=%u, size=%u, #(A-B)=%u, #(B-A)=%u, #(A&B)=%u\n",
-          hash_num, ibf_size, asize, bsize, csize);
+  if (text)
+    printf ("hash-num=%u, size=%u, #(A-B)=%u, #(B-A)=%u, #(A&B)=%u\n",
+            hash_num, ibf_size, asize, bsize, csize);
 
   i = 0;
   while (i < asize)
@@ -172,7 +287,8 @@ run (void *cls, char *const *args, const char *cfgfile,
   ibf_a = ibf_create (ibf_size, hash_num);
   ibf_b = ibf_create (ibf_size, hash_num);
 
-  printf ("generated sets\n");
+  if (text)
+    printf ("generated sets\n");
 
   start_time = GNUNET_TIME_absolute_get ();
 
@@ -181,11 +297,12 @@ run (void *cls, char *const *args, const char *cfgfile,
   GNUNET_CONTAINER_multihashmap_iterate (set_c, &insert_iterator, ibf_a);
   GNUNET_CONTAINER_multihashmap_iterate (set_c, &insert_iterator, ibf_b);
 
-  delta_time = GNUNET_TIME_absolute_get_duration (start_time);
+  encode_time = GNUNET_TIME_absolute_get_duration (start_time);
 
-  printf ("encoded in: %s\n",
-          GNUNET_STRINGS_relative_time_to_string (delta_time,
-                                                  GNUNET_NO));
+  if (text)
+    printf ("encoded in: %s\n",
+            GNUNET_STRINGS_relative_time_to_string (encode_time,
+                                                    GNUNET_NO));
 
   ibf_subtract (ibf_a, ibf_b);
 
@@ -197,25 +314,18 @@ run (void *cls, char *const *args, const char *cfgfile,
     res = ibf_decode (ibf_a, &side, &ibf_key);
     if (GNUNET_SYSERR == res)
     {
-      printf ("decode failed, %u/%u elements left\n",
-         GNUNET_CONTAINER_multihashmap_size (set_a) + GNUNET_CONTAINER_multihashmap_size (set_b),
-         asize + bsize);
+      report ("failed", encode_time,
+              GNUNET_TIME_absolute_get_duration (start_time));
       return;
     }
     if (GNUNET_NO == res)
     {
+      delta_time = GNUNET_TIME_absolute_get_duration (start_time);
       if ((0 == GNUNET_CONTAINER_multihashmap_size (set_b)) &&
           (0 == GNUNET_CONTAINER_multihashmap_size (set_a)))
-      {
-        delta_time = GNUNET_TIME_absolute_get_duration (start_time);
-        printf ("decoded successfully in: %s\n",
-                GNUNET_STRINGS_relative_time_to_string (delta_time,
-                                                        GNUNET_NO));
-      }
+        report ("ok", encode_time, delta_time);
       else
-      {
-        printf ("decode missed elements (should never happen)\n");
-      }
+        report ("missed", encode_time, delta_time);
       return;
     }
 
@@ -224,9 +334,8 @@ run (void *cls, char *const *args, const char *cfgfile,
     if (side == -1)
       iter_hashcodes (ibf_key, remove_iterator, set_b);
   }
-  printf("cyclic IBF, %u/%u elements left\n",
-         GNUNET_CONTAINER_multihashmap_size (set_a) + GNUNET_CONTAINER_multihashmap_size (set_b),
-         asize + bsize);
+  report ("cyclic", encode_time,
+          GNUNET_TIME_absolute_get_duration (start_time));
 }
 
 int
@@ -248,6 +357,12 @@ main (int argc, char **argv)
     {'s', "ibf-size", NULL,
      gettext_noop ("ibf size"), 1,
      &GNUNET_GETOPT_set_uint, &ibf_size},
+    {'f', "format", NULL,
+     gettext_noop ("output format (text, csv or json)"), 1,
+     &GNUNET_GETOPT_set_string, &format_str},
+    {'o', "output", NULL,
+     gettext_noop ("append the result to this file"), 1,
+     &GNUNET_GETOPT_set_filename, &output_filename},
     GNUNET_GETOPT_OPTION_END
   };
   GNUNET_PROGRAM_run2 (argc, argv, "gnunet-consensus-ibf",
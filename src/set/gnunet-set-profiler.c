@@ -18,16 +18,30 @@
       Boston, MA 02110-1301, USA.
 */
 
+
 /**
  * @file set/gnunet-set-profiler.c
  * @brief profiling tool for set
  * @author Florian Dold
+ *
+ * Runs one set operation between two local sets and reports the
+ * wall time, the p2p traffic and rounds (taken from the statistics
+ * of the set service) and the peak memory.  Together with
+ * contrib/set-profiler-matrix.sh, each invocation is one cell of
+ * the benchmark matrix.
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
 #include "gnunet_set_service.h"
+#include "gnunet_statistics_service.h"
 #include "gnunet_testbed_service.h"
 
+/**
+ * How long do we give the set service to flush its statistics
+ * after an operation has finished?
+ */
+#define STATISTICS_SETTLE_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 2)
+
 
 static int ret;
 
@@ -37,6 +51,26 @@ static unsigned int num_c = 20;
 
 static char *op_str = "union";
 
+/**
+ * Size of each element in bytes.
+ */
+static unsigned int element_size = sizeof (struct GNUNET_HashCode);
+
+/**
+ * Seed for generating the elements, 0 for a random seed.
+ */
+static unsigned int seed;
+
+/**
+ * Output format, "text", "csv" or "json".
+ */
+static char *format_str = "text";
+
+/**
+ * File to append the result row to, NULL for stdout.
+ */
+static char *output_filename;
+
 const static struct GNUNET_CONFIGURATION_Handle *config;
 
 struct SetInfo
@@ -46,9 +80,49 @@ struct SetInfo
   struct GNUNET_SET_OperationHandle *oh;
   struct GNUNET_CONTAINER_MultiHashMap *sent;
   struct GNUNET_CONTAINER_MultiHashMap *received;
+  /**
+   * Number of elements still to be given to @e set.
+   */
+  unsigned int to_add;
   int done;
 } info1, info2;
 
+/**
+ * Statistic of the set service we report on, with its value before
+ * and after the operation.
+ */
+struct StatValue
+{
+  const char *name;
+  uint64_t before;
+  uint64_t after;
+};
+
+/**
+ * Statistics of the set service we are interested in.
+ */
+static struct StatValue stat_values[] = {
+  { "# p2p bytes received by initiator", 0, 0 },
+  { "# p2p bytes received by acceptor", 0, 0 },
+  { "# p2p messages received by initiator", 0, 0 },
+  { "# p2p messages received by acceptor", 0, 0 },
+  { "# union IBF segments sent", 0, 0 },
+  { "# intersection filter rounds", 0, 0 },
+  { "# peak resident set size (KiB)", 0, 0 },
+  { NULL, 0, 0 }
+};
+
+enum StatIndex
+{
+  STAT_BYTES_INITIATOR,
+  STAT_BYTES_ACCEPTOR,
+  STAT_MESSAGES_INITIATOR,
+  STAT_MESSAGES_ACCEPTOR,
+  STAT_IBF_SEGMENTS,
+  STAT_FILTER_ROUNDS,
+  STAT_PEAK_RSS
+};
+
 static struct GNUNET_CONTAINER_MultiHashMap *common_sent;
 
 static struct GNUNET_HashCode app_id;
@@ -57,6 +131,21 @@ static struct GNUNET_PeerIdentity local_peer;
 
 static struct GNUNET_SET_ListenHandle *set_listener;
 
+static struct GNUNET_STATISTICS_Handle *statistics;
+
+static struct GNUNET_STATISTICS_GetHandle *stat_get;
+
+static enum GNUNET_SET_OperationType operation;
+
+static struct GNUNET_TIME_Absolute start_time;
+
+static struct GNUNET_TIME_Relative wall_time;
+
+/**
+ * #GNUNET_YES if the operation failed.
+ */
+static int failed;
+
 
 static int
 map_remove_iterator (void *cls,
@@ -76,28 +165,263 @@ map_remove_iterator (void *cls,
 }
 
 
+/**
+ * Get the peak resident set size of this process.
+ *
+ * @return peak RSS in KiB, 0 if unknown
+ */
+static unsigned long long
+get_own_peak_rss ()
+{
+#if HAVE_GETRUSAGE
+  struct rusage ru;
+
+  if (0 == getrusage (RUSAGE_SELF, &ru))
+    return ru.ru_maxrss;
+#endif
+  return 0;
+}
+
+
+/**
+ * Get the change of a statistic during the operation.
+ *
+ * @param idx which statistic
+ * @return difference of the value after and before the operation
+ */
+static unsigned long long
+stat_delta (enum StatIndex idx)
+{
+  if (stat_values[idx].after < stat_values[idx].before)
+    return 0;
+  return stat_values[idx].after - stat_values[idx].before;
+}
+
+
+/**
+ * Print the result of the run in the selected format.
+ */
 static void
-check_all_done (void)
+print_result ()
 {
-  if (info1.done == GNUNET_NO || info2.done == GNUNET_NO)
-    return;
+  FILE *f;
+  unsigned long long rounds;
 
-  GNUNET_CONTAINER_multihashmap_iterate (info1.received, map_remove_iterator, info2.sent);
-  GNUNET_CONTAINER_multihashmap_iterate (info2.received, map_remove_iterator, info1.sent);
+  f = stdout;
+  if (NULL != output_filename)
+  {
+    f = fopen (output_filename, "a");
+    if (NULL == f)
+    {
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                                "fopen",
+                                output_filename);
+      ret = 1;
+      return;
+    }
+  }
+  rounds = (GNUNET_SET_OPERATION_UNION == operation)
+    ? stat_delta (STAT_IBF_SEGMENTS)
+    : stat_delta (STAT_FILTER_ROUNDS);
+  if (0 == strcasecmp (format_str, "csv"))
+  {
+    /* only write the header once per file */
+    if ( (stdout == f) ||
+         ( (0 == fseek (f, 0, SEEK_END)) &&
+           (0 == ftell (f)) ) )
+      fprintf (f,
+               "operation,num_a,num_b,num_c,element_size,seed,status,"
+               "wall_us,bytes_to_initiator,bytes_to_acceptor,"
+               "messages_to_initiator,messages_to_acceptor,rounds,"
+               "service_peak_rss_kib,profiler_peak_rss_kib,"
+               "missing_a,missing_b\n");
+    fprintf (f,
+             "%s,%u,%u,%u,%u,%u,%s,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%u,%u\n",
+             op_str, num_a, num_b, num_c, element_size, seed,
+             failed ? "failure" : "ok",
+             (unsigned long long) wall_time.rel_value_us,
+             stat_delta (STAT_BYTES_INITIATOR),
+             stat_delta (STAT_BYTES_ACCEPTOR),
+             stat_delta (STAT_MESSAGES_INITIATOR),
+             stat_delta (STAT_MESSAGES_ACCEPTOR),
+             rounds,
+             (unsigned long long) stat_values[STAT_PEAK_RSS].after,
+             get_own_peak_rss (),
+             GNUNET_CONTAINER_multihashmap_size (info1.sent),
+             GNUNET_CONTAINER_multihashmap_size (info2.sent));
+  }
+  else if (0 == strcasecmp (format_str, "json"))
+  {
+    /* one object per line, so that runs can be appended */
+    fprintf (f,
+             "{\"operation\": \"%s\", \"num_a\": %u, \"num_b\": %u, "
+             "\"num_c\": %u, \"element_size\": %u, \"seed\": %u, "
+             "\"status\": \"%s\", \"wall_us\": %llu, "
+             "\"bytes_to_initiator\": %llu, \"bytes_to_acceptor\": %llu, "
+             "\"messages_to_initiator\": %llu, \"messages_to_acceptor\": %llu, "
+             "\"rounds\": %llu, \"service_peak_rss_kib\": %llu, "
+             "\"profiler_peak_rss_kib\": %llu, "
+             "\"missing_a\": %u, \"missing_b\": %u}\n",
+             op_str, num_a, num_b, num_c, element_size, seed,
+             failed ? "failure" : "ok",
+             (unsigned long long) wall_time.rel_value_us,
+             stat_delta (STAT_BYTES_INITIATOR),
+             stat_delta (STAT_BYTES_ACCEPTOR),
+             stat_delta (STAT_MESSAGES_INITIATOR),
+             stat_delta (STAT_MESSAGES_ACCEPTOR),
+             rounds,
+             (unsigned long long) stat_values[STAT_PEAK_RSS].after,
+             get_own_peak_rss (),
+             GNUNET_CONTAINER_multihashmap_size (info1.sent),
+             GNUNET_CONTAINER_multihashmap_size (info2.sent));
+  }
+  else
+  {
+    fprintf (f, "set a: %d missing elements\n",
+             GNUNET_CONTAINER_multihashmap_size (info1.sent));
+    fprintf (f, "set b: %d missing elements\n",
+             GNUNET_CONTAINER_multihashmap_size (info2.sent));
+    fprintf (f, "%s %s in %s (seed %u)\n",
+             op_str,
+             failed ? "failed" : "done",
+             GNUNET_STRINGS_relative_time_to_string (wall_time,
+                                                     GNUNET_YES),
+             seed);
+    fprintf (f, "p2p traffic: %llu bytes / %llu messages to initiator, "
+             "%llu bytes / %llu messages to acceptor, %llu rounds\n",
+             stat_delta (STAT_BYTES_INITIATOR),
+             stat_delta (STAT_MESSAGES_INITIATOR),
+             stat_delta (STAT_BYTES_ACCEPTOR),
+             stat_delta (STAT_MESSAGES_ACCEPTOR),
+             rounds);
+    fprintf (f, "peak memory: set service %llu KiB, profiler %llu KiB\n",
+             (unsigned long long) stat_values[STAT_PEAK_RSS].after,
+             get_own_peak_rss ());
+  }
+  if (stdout != f)
+    GNUNET_break (0 == fclose (f));
+}
+
+
+/**
+ * Remember the value of a statistic we are interested in.
+ *
+ * @param cls #GNUNET_YES for the values before the operation
+ * @param subsystem name of subsystem that created the statistic
+ * @param name the name of the datum
+ * @param value the current value
+ * @param is_persistent #GNUNET_YES if the value is persistent, #GNUNET_NO if not
+ * @return #GNUNET_OK to continue
+ */
+static int
+statistics_iterator (void *cls,
+                     const char *subsystem,
+                     const char *name,
+                     uint64_t value,
+                     int is_persistent)
+{
+  int *is_before = cls;
+  unsigned int i;
+
+  for (i = 0; NULL != stat_values[i].name; i++)
+  {
+    if (0 != strcmp (name, stat_values[i].name))
+      continue;
+    if (GNUNET_YES == *is_before)
+      stat_values[i].before = value;
+    else
+      stat_values[i].after = value;
+  }
+  return GNUNET_OK;
+}
 
-  printf ("set a: %d missing elements\n", GNUNET_CONTAINER_multihashmap_size (info1.sent));
-  printf ("set b: %d missing elements\n", GNUNET_CONTAINER_multihashmap_size (info2.sent));
 
+/**
+ * Called once the statistics after the operation have been
+ * retrieved.  Print the result and terminate.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK if statistics were obtained
+ */
+static void
+statistics_after_done (void *cls,
+                       int success)
+{
+  stat_get = NULL;
+  if (GNUNET_OK != success)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "could not obtain statistics of the set service\n");
+  print_result ();
   GNUNET_SCHEDULER_shutdown ();
 }
 
 
+/**
+ * Fetch the statistics of the set service once the service had the
+ * time to flush them.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+fetch_statistics_after (void *cls,
+                        const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  static int is_before = GNUNET_NO;
+
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  stat_get = GNUNET_STATISTICS_get (statistics, "set", NULL,
+                                    GNUNET_TIME_UNIT_MINUTES,
+                                    &statistics_after_done,
+                                    &statistics_iterator,
+                                    &is_before);
+}
+
+
+static void
+finish_run (void)
+{
+  static int finished;
+
+  if (GNUNET_YES == finished)
+    return;
+  finished = GNUNET_YES;
+  wall_time = GNUNET_TIME_absolute_get_duration (start_time);
+  GNUNET_SCHEDULER_add_delayed (STATISTICS_SETTLE_DELAY,
+                                &fetch_statistics_after, NULL);
+}
+
+
+static void
+check_all_done (void)
+{
+  if (info1.done == GNUNET_NO || info2.done == GNUNET_NO)
+    return;
+
+  if (GNUNET_SET_OPERATION_UNION == operation)
+  {
+    /* each side receives the elements only the other side has */
+    GNUNET_CONTAINER_multihashmap_iterate (info1.received, map_remove_iterator, info2.sent);
+    GNUNET_CONTAINER_multihashmap_iterate (info2.received, map_remove_iterator, info1.sent);
+  }
+  else
+  {
+    /* each side removes the elements only it has */
+    GNUNET_CONTAINER_multihashmap_iterate (info1.received, map_remove_iterator, info1.sent);
+    GNUNET_CONTAINER_multihashmap_iterate (info2.received, map_remove_iterator, info2.sent);
+  }
+  finish_run ();
+}
+
+
 static void
 set_result_cb (void *cls,
                  const struct GNUNET_SET_Element *element,
                  enum GNUNET_SET_Status status)
 {
   struct SetInfo *info = cls;
+  struct GNUNET_HashCode key;
 
   GNUNET_assert (GNUNET_NO == info->done);
   switch (status)
@@ -106,13 +430,15 @@ set_result_cb (void *cls,
     case GNUNET_SET_STATUS_HALF_DONE:
       info->done = GNUNET_YES;
       GNUNET_log (GNUNET_ERROR_TYPE_INFO, "set %s done\n", info->id);
-      check_all_done ();
       info->oh = NULL;
+      check_all_done ();
       return;
     case GNUNET_SET_STATUS_FAILURE:
       info->oh = NULL;
       GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "failure\n");
-      GNUNET_SCHEDULER_shutdown ();
+      failed = GNUNET_YES;
+      ret = 1;
+      finish_run ();
       return;
     case GNUNET_SET_STATUS_OK:
       break;
@@ -120,17 +446,20 @@ set_result_cb (void *cls,
       GNUNET_assert (0);
   }
 
-  if (element->size != sizeof (struct GNUNET_HashCode))
+  if (element->size != element_size)
   {
     GNUNET_log (GNUNET_ERROR_TYPE_INFO, "wrong element size: %u\n", element->size);
     GNUNET_assert (0);
   }
 
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO, "set %s: got element (%s)\n",
-              info->id, GNUNET_h2s (element->data));
   GNUNET_assert (NULL != element->data);
+  /* elements start with (a prefix of) their key */
+  memset (&key, 0, sizeof key);
+  memcpy (&key, element->data, GNUNET_MIN (element->size, sizeof key));
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO, "set %s: got element (%s)\n",
+              info->id, GNUNET_h2s (&key));
   GNUNET_CONTAINER_multihashmap_put (info->received,
-                                     element->data, NULL,
+                                     &key, NULL,
                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
 }
 
@@ -150,36 +479,171 @@ set_listen_cb (void *cls,
   GNUNET_assert (NULL == info2.oh);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "set listen cb called\n");
-  info2.oh = GNUNET_SET_accept (request, GNUNET_SET_RESULT_ADDED,
-                               set_result_cb, &info2);
+  info2.oh = GNUNET_SET_accept (request,
+                                (GNUNET_SET_OPERATION_UNION == operation)
+                                ? GNUNET_SET_RESULT_ADDED
+                                : GNUNET_SET_RESULT_REMOVED,
+                                set_result_cb, &info2);
   GNUNET_SET_commit (info2.oh, info2.set);
 }
 
 
+/**
+ * Both sets have been filled, start the operation.
+ */
+static void
+start_operation ()
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "sets filled, starting %s\n",
+              op_str);
+  start_time = GNUNET_TIME_absolute_get ();
+  set_listener = GNUNET_SET_listen (config, operation,
+                                    &app_id, set_listen_cb, NULL);
+
+  info1.oh = GNUNET_SET_prepare (&local_peer, &app_id, NULL,
+                                 (GNUNET_SET_OPERATION_UNION == operation)
+                                 ? GNUNET_SET_RESULT_ADDED
+                                 : GNUNET_SET_RESULT_REMOVED,
+                                 set_result_cb, &info1);
+  GNUNET_SET_commit (info1.oh, info1.set);
+  GNUNET_SET_destroy (info1.set);
+  info1.set = NULL;
+}
+
+
+/**
+ * Called once the last element was given to a set.
+ *
+ * @param cls the `struct SetInfo` of the set
+ */
+static void
+set_filled_cb (void *cls)
+{
+  struct SetInfo *info = cls;
+
+  GNUNET_assert (0 == info->to_add);
+  info->to_add = UINT_MAX;
+  if ( (UINT_MAX == info1.to_add) &&
+       (UINT_MAX == info2.to_add) )
+    start_operation ();
+}
+
+
 static int
 set_insert_iterator (void *cls,
                      const struct GNUNET_HashCode *key,
                      void *value)
 {
-  struct GNUNET_SET_Handle *set = cls;
+  struct SetInfo *info = cls;
   struct GNUNET_SET_Element *el;
+  char *data;
+  unsigned int i;
 
   el = GNUNET_malloc (sizeof (struct GNUNET_SET_Element) +
-                      sizeof (struct GNUNET_HashCode));
+                      element_size);
   el->element_type = 0;
-  memcpy (&el[1], key, sizeof *key);
-  el->data = &el[1];
-  el->size = sizeof *key;
-  GNUNET_SET_add_element (set, el, NULL, NULL);
+  data = (char *) &el[1];
+  /* repeat the key to pad the element to the requested size */
+  for (i = 0; i < element_size; i++)
+    data[i] = ((const char *) key)[i % sizeof *key];
+  el->data = data;
+  el->size = element_size;
+  GNUNET_assert (0 < info->to_add);
+  info->to_add--;
+  GNUNET_SET_add_element (info->set, el,
+                          (0 == info->to_add) ? &set_filled_cb : NULL,
+                          info);
   GNUNET_free (el);
   return GNUNET_YES;
 }
 
 
+/**
+ * Deterministically generate @a count elements from the seed and
+ * put them into @a map, skipping elements already in any of the
+ * maps.
+ *
+ * @param map map to fill
+ * @param tag distinguishes the maps
+ * @param count number of elements to generate
+ */
+static void
+generate_elements (struct GNUNET_CONTAINER_MultiHashMap *map,
+                   uint32_t tag,
+                   unsigned int count)
+{
+  struct GNUNET_HashCode hash;
+  uint32_t input[3];
+  uint32_t ctr;
+
+  input[0] = htonl (seed);
+  input[1] = htonl (tag);
+  ctr = 0;
+  while (GNUNET_CONTAINER_multihashmap_size (map) < count)
+  {
+    input[2] = htonl (ctr++);
+    GNUNET_CRYPTO_hash (input, sizeof input, &hash);
+    /* elements shorter than a hash only carry a prefix of it */
+    if (element_size < sizeof hash)
+      memset ((char *) &hash + element_size, 0, sizeof hash - element_size);
+    if ( (GNUNET_YES == GNUNET_CONTAINER_multihashmap_contains (info1.sent, &hash)) ||
+         (GNUNET_YES == GNUNET_CONTAINER_multihashmap_contains (info2.sent, &hash)) ||
+         (GNUNET_YES == GNUNET_CONTAINER_multihashmap_contains (common_sent, &hash)) )
+      continue;
+    GNUNET_CONTAINER_multihashmap_put (map, &hash, NULL,
+                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+  }
+}
+
+
+/**
+ * Fill both sets, once we know the statistics before the operation.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK if statistics were obtained
+ */
+static void
+statistics_before_done (void *cls,
+                        int success)
+{
+  stat_get = NULL;
+  if (GNUNET_OK != success)
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "could not obtain statistics of the set service\n");
+
+  info1.set = GNUNET_SET_create (config, operation);
+  info2.set = GNUNET_SET_create (config, operation);
+  info1.to_add = num_a + num_c;
+  info2.to_add = num_b + num_c;
+
+  GNUNET_CONTAINER_multihashmap_iterate (info1.sent, set_insert_iterator, &info1);
+  GNUNET_CONTAINER_multihashmap_iterate (info2.sent, set_insert_iterator, &info2);
+  GNUNET_CONTAINER_multihashmap_iterate (common_sent, set_insert_iterator, &info1);
+  GNUNET_CONTAINER_multihashmap_iterate (common_sent, set_insert_iterator, &info2);
+
+  /* empty sets have nothing to wait for */
+  if (0 == num_a + num_c)
+    set_filled_cb (&info1);
+  if (0 == num_b + num_c)
+    set_filled_cb (&info2);
+}
+
+
 static void
 handle_shutdown (void *cls,
                  const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  if (NULL != stat_get)
+  {
+    GNUNET_STATISTICS_get_cancel (stat_get);
+    stat_get = NULL;
+  }
+  if (NULL != statistics)
+  {
+    GNUNET_STATISTICS_destroy (statistics, GNUNET_NO);
+    statistics = NULL;
+  }
   if (NULL != set_listener)
   {
     GNUNET_SET_listen_cancel (set_listener);
@@ -212,11 +676,39 @@ static void
 run (void *cls, char *const *args, const char *cfgfile,
      const struct GNUNET_CONFIGURATION_Handle *cfg)
 {
-  unsigned int i;
-  struct GNUNET_HashCode hash;
+  static int is_before = GNUNET_YES;
 
   config = cfg;
 
+  if (0 == strcasecmp (op_str, "union"))
+    operation = GNUNET_SET_OPERATION_UNION;
+  else if (0 == strcasecmp (op_str, "intersection"))
+    operation = GNUNET_SET_OPERATION_INTERSECTION;
+  else
+  {
+    fprintf (stderr, "unknown operation `%s'\n", op_str);
+    ret = 1;
+    return;
+  }
+  if ( (0 != strcasecmp (format_str, "text")) &&
+       (0 != strcasecmp (format_str, "csv")) &&
+       (0 != strcasecmp (format_str, "json")) )
+  {
+    fprintf (stderr, "unknown output format `%s'\n", format_str);
+    ret = 1;
+    return;
+  }
+  /* short elements would collide too often to be told apart */
+  if ( (element_size < sizeof (uint64_t)) ||
+       (element_size > GNUNET_SET_CONTEXT_MESSAGE_MAX_SIZE) )
+  {
+    fprintf (stderr, "element size must be between %u and %u bytes\n",
+             (unsigned int) sizeof (uint64_t),
+             (unsigned int) GNUNET_SET_CONTEXT_MESSAGE_MAX_SIZE);
+    ret = 1;
+    return;
+  }
+
   if (GNUNET_OK != GNUNET_CRYPTO_get_peer_identity (cfg, &local_peer))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_ERROR, "could not retrieve host identity\n");
@@ -226,6 +718,11 @@ run (void *cls, char *const *args, const char *cfgfile,
 
   GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL, handle_shutdown, NULL);
 
+  /* pick a seed that can be reported, to make the run reproducible */
+  if (0 == seed)
+    seed = 1 + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                         UINT32_MAX - 1);
+
   info1.id = "a";
   info2.id = "b";
 
@@ -236,48 +733,18 @@ run (void *cls, char *const *args, const char *cfgfile,
   info1.received = GNUNET_CONTAINER_multihashmap_create (num_a+1, GNUNET_NO);
   info2.received = GNUNET_CONTAINER_multihashmap_create (num_b+1, GNUNET_NO);
 
-  for (i = 0; i < num_a; i++)
-  {
-    GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_STRONG, &hash);
-    GNUNET_CONTAINER_multihashmap_put (info1.sent, &hash, NULL,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
-  }
-
-  for (i = 0; i < num_b; i++)
-  {
-    GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_STRONG, &hash);
-    GNUNET_CONTAINER_multihashmap_put (info2.sent, &hash, NULL,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
-  }
+  generate_elements (info1.sent, 1, num_a);
+  generate_elements (info2.sent, 2, num_b);
+  generate_elements (common_sent, 3, num_c);
 
-  for (i = 0; i < num_c; i++)
-  {
-    GNUNET_CRYPTO_hash_create_random (GNUNET_CRYPTO_QUALITY_STRONG, &hash);
-    GNUNET_CONTAINER_multihashmap_put (common_sent, &hash, NULL,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_REPLACE);
-  }
+  GNUNET_CRYPTO_hash (&seed, sizeof seed, &app_id);
 
-  /* use last hash for app id */
-  app_id = hash;
-
-  /* FIXME: also implement intersection etc. */
-  info1.set = GNUNET_SET_create (config, GNUNET_SET_OPERATION_UNION);
-  info2.set = GNUNET_SET_create (config, GNUNET_SET_OPERATION_UNION);
-
-  GNUNET_CONTAINER_multihashmap_iterate (info1.sent, set_insert_iterator, info1.set);
-  GNUNET_CONTAINER_multihashmap_iterate (info2.sent, set_insert_iterator, info2.set);
-  GNUNET_CONTAINER_multihashmap_iterate (common_sent, set_insert_iterator, info1.set);
-  GNUNET_CONTAINER_multihashmap_iterate (common_sent, set_insert_iterator, info2.set);
-
-  set_listener = GNUNET_SET_listen (config, GNUNET_SET_OPERATION_UNION,
-                                    &app_id, set_listen_cb, NULL);
-
-  info1.oh = GNUNET_SET_prepare (&local_peer, &app_id, NULL,
-                                 GNUNET_SET_RESULT_ADDED,
-                                 set_result_cb, &info1);
-  GNUNET_SET_commit (info1.oh, info1.set);
-  GNUNET_SET_destroy (info1.set);
-  info1.set = NULL;
+  statistics = GNUNET_STATISTICS_create ("set-profiler", cfg);
+  stat_get = GNUNET_STATISTICS_get (statistics, "set", NULL,
+                                    GNUNET_TIME_UNIT_MINUTES,
+                                    &statistics_before_done,
+                                    &statistics_iterator,
+                                    &is_before);
 }
 
 
@@ -295,8 +762,20 @@ main (int argc, char **argv)
         gettext_noop ("number of values"),
         GNUNET_YES, &GNUNET_GETOPT_set_uint, &num_c },
       { 'x', "operation", NULL,
-        gettext_noop ("oeration to execute"),
+        gettext_noop ("operation to execute (union or intersection)"),
         GNUNET_YES, &GNUNET_GETOPT_set_string, &op_str },
+      { 'e', "element-size", NULL,
+        gettext_noop ("size of each element in bytes"),
+        GNUNET_YES, &GNUNET_GETOPT_set_uint, &element_size },
+      { 's', "seed", NULL,
+        gettext_noop ("seed for generating the elements (0 for random)"),
+        GNUNET_YES, &GNUNET_GETOPT_set_uint, &seed },
+      { 'f', "format", NULL,
+        gettext_noop ("output format (text, csv or json)"),
+        GNUNET_YES, &GNUNET_GETOPT_set_string, &format_str },
+      { 'o', "output", NULL,
+        gettext_noop ("append the result to this file"),
+        GNUNET_YES, &GNUNET_GETOPT_set_filename, &output_filename },
       GNUNET_GETOPT_OPTION_END
   };
   GNUNET_PROGRAM_run (argc, argv, "gnunet-set-profiler",
@@ -304,4 +783,3 @@ main (int argc, char **argv)
                       options, &run, NULL);
   return ret;
 }
-
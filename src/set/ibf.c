@@ -64,6 +64,24 @@ ibf_hashcode_from_key (struct IBF_Key key, struct GNUNET_HashCode *dst)
 }
 
 
+/**
+ * Point the bucket arrays of an IBF into one allocation of
+ * ibf->size * #IBF_BUCKET_SIZE bytes (keys, key hashes, counts;
+ * each array stays aligned for its type).
+ *
+ * @param ibf the IBF, with its size set
+ * @param mem the allocation
+ */
+static void
+ibf_set_arrays (struct InvertibleBloomFilter *ibf,
+                void *mem)
+{
+  ibf->key_sum = mem;
+  ibf->key_hash_sum = (struct IBF_KeyHash *) &ibf->key_sum[ibf->size];
+  ibf->count = (struct IBF_Count *) &ibf->key_hash_sum[ibf->size];
+}
+
+
 /**
  * Create an invertible bloom filter.
  *
@@ -76,20 +94,23 @@ ibf_create (uint32_t size, uint8_t hash_num)
 {
   struct InvertibleBloomFilter *ibf;
 
-  /* TODO: use malloc_large */
-
   ibf = GNUNET_new (struct InvertibleBloomFilter);
-  ibf->count = GNUNET_malloc (size * sizeof (uint8_t));
-  ibf->key_sum = GNUNET_malloc (size * sizeof (struct IBF_Key));
-  ibf->key_hash_sum = GNUNET_malloc (size * sizeof (struct IBF_KeyHash));
   ibf->size = size;
   ibf->hash_num = hash_num;
-
+  ibf_set_arrays (ibf, GNUNET_malloc_large (size * IBF_BUCKET_SIZE));
+  GNUNET_assert (NULL != ibf->key_sum);
+  memset (ibf->key_sum, 0, size * IBF_BUCKET_SIZE);
   return ibf;
 }
 
+
 /**
  * Store unique bucket indices for the specified key in dst.
+ *
+ * The other peer must derive the same indices for the IBFs we
+ * exchange, so this is part of the protocol and must not change
+ * (including the duplicate check comparing against the unreduced
+ * hash).  A non-zero salt changes the key before hashing.
  */
 static inline void
 ibf_get_indices (const struct InvertibleBloomFilter *ibf,
@@ -99,6 +120,7 @@ ibf_get_indices (const struct InvertibleBloomFilter *ibf,
   uint32_t i;
   uint32_t bucket;
 
+  key.key_val += (uint64_t) ibf->salt * 0x9e3779b97f4a7c15LL;
   bucket = GNUNET_CRYPTO_crc32_n (&key, sizeof key);
   for (i = 0, filled=0; filled < ibf->hash_num; i++)
   {
@@ -115,11 +137,30 @@ ibf_get_indices (const struct InvertibleBloomFilter *ibf,
 }
 
 
+/**
+ * Remember that a bucket may have become pure.
+ *
+ * @param ibf the IBF
+ * @param bucket index of the bucket
+ */
+static void
+ibf_push_candidate (struct InvertibleBloomFilter *ibf,
+                    uint32_t bucket)
+{
+  if (ibf->candidates_len == ibf->candidates_size)
+    GNUNET_array_grow (ibf->candidates,
+                       ibf->candidates_size,
+                       GNUNET_MAX (16, 2 * ibf->candidates_size));
+  ibf->candidates[ibf->candidates_len++] = bucket;
+}
+
+
 static void
 ibf_insert_into  (struct InvertibleBloomFilter *ibf,
                   struct IBF_Key key,
                   const int *buckets, int side)
 {
+  const uint32_t key_hash = IBF_KEY_HASH_VAL (key);
   int i;
 
   for (i = 0; i < ibf->hash_num; i++)
@@ -127,8 +168,11 @@ ibf_insert_into  (struct InvertibleBloomFilter *ibf,
     const int bucket = buckets[i];
     ibf->count[bucket].count_val += side;
     ibf->key_sum[bucket].key_val ^= key.key_val;
-    ibf->key_hash_sum[bucket].key_hash_val
-        ^= IBF_KEY_HASH_VAL (key);
+    ibf->key_hash_sum[bucket].key_hash_val ^= key_hash;
+    if ( (GNUNET_YES == ibf->candidates_valid) &&
+         ( (1 == ibf->count[bucket].count_val) ||
+           (-1 == ibf->count[bucket].count_val) ) )
+      ibf_push_candidate (ibf, bucket);
   }
 }
 
@@ -144,6 +188,7 @@ ibf_insert (struct InvertibleBloomFilter *ibf, struct IBF_Key key)
 {
   int buckets[ibf->hash_num];
   GNUNET_assert (ibf->hash_num <= ibf->size);
+  ibf->candidates_valid = GNUNET_NO;
   ibf_get_indices (ibf, key, buckets);
   ibf_insert_into (ibf, key, buckets, 1);
 }
@@ -160,6 +205,7 @@ ibf_remove (struct InvertibleBloomFilter *ibf, struct IBF_Key key)
 {
   int buckets[ibf->hash_num];
   GNUNET_assert (ibf->hash_num <= ibf->size);
+  ibf->candidates_valid = GNUNET_NO;
   ibf_get_indices (ibf, key, buckets);
   ibf_insert_into (ibf, key, buckets, -1);
 }
@@ -171,22 +217,40 @@ ibf_remove (struct InvertibleBloomFilter *ibf, struct IBF_Key key)
 static int
 ibf_is_empty (struct InvertibleBloomFilter *ibf)
 {
-  int i;
+  const uint8_t *mem = (const uint8_t *) ibf->key_sum;
+  uint8_t acc = 0;
+  size_t i;
+
+  /* all three arrays are in one block */
+  for (i = 0; i < ibf->size * IBF_BUCKET_SIZE; i++)
+    acc |= mem[i];
+  return (0 == acc) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Collect all buckets that may be pure.
+ *
+ * @param ibf the IBF
+ */
+static void
+ibf_collect_candidates (struct InvertibleBloomFilter *ibf)
+{
+  uint32_t i;
+
+  ibf->candidates_len = 0;
+  ibf->candidates_valid = GNUNET_YES;
   for (i = 0; i < ibf->size; i++)
-  {
-    if (0 != ibf->count[i].count_val)
-      return GNUNET_NO;
-    if (0 != ibf->key_hash_sum[i].key_hash_val)
-      return GNUNET_NO;
-    if (0 != ibf->key_sum[i].key_val)
-      return GNUNET_NO;
-  }
-  return GNUNET_YES;
+    if ( (1 == ibf->count[i].count_val) ||
+         (-1 == ibf->count[i].count_val) )
+      ibf_push_candidate (ibf, i);
 }
 
 
 /**
  * Decode and remove an element from the IBF, if possible.
+ * The buckets that may be pure are collected once; afterwards only
+ * the buckets changed by removing decoded elements are rechecked.
  *
  * @param ibf the invertible bloom filter to decode
  * @param ret_side sign of the cell's count where the decoded element came from.
@@ -202,16 +266,20 @@ ibf_decode (struct InvertibleBloomFilter *ibf,
             int *ret_side, struct IBF_Key *ret_id)
 {
   struct IBF_KeyHash hash;
-  int i;
+  uint32_t i;
   int buckets[ibf->hash_num];
 
   GNUNET_assert (NULL != ibf);
 
-  for (i = 0; i < ibf->size; i++)
+  if (GNUNET_YES != ibf->candidates_valid)
+    ibf_collect_candidates (ibf);
+  while (ibf->candidates_len > 0)
   {
     int j;
     int hit;
 
+    i = ibf->candidates[--ibf->candidates_len];
+
     /* we can only decode from pure buckets */
     if ((1 != ibf->count[i].count_val) && (-1 != ibf->count[i].count_val))
       continue;
@@ -227,7 +295,7 @@ ibf_decode (struct InvertibleBloomFilter *ibf,
     hit = GNUNET_NO;
     ibf_get_indices (ibf, ibf->key_sum[i], buckets);
     for (j = 0; j < ibf->hash_num; j++)
-      if (buckets[j] == i)
+      if (buckets[j] == (int) i)
         hit = GNUNET_YES;
 
     if (GNUNET_NO == hit)
@@ -311,6 +379,7 @@ ibf_read_slice (const void *buf, uint32_t start, uint32_t count, struct Invertib
   /* copy counts */
   count_src = (struct IBF_Count *) key_hash_src;
   memcpy (ibf->count + start, count_src, count * sizeof *count_src);
+  ibf->candidates_valid = GNUNET_NO;
 }
 
 
@@ -324,17 +393,26 @@ ibf_read_slice (const void *buf, uint32_t start, uint32_t count, struct Invertib
 void
 ibf_subtract (struct InvertibleBloomFilter *ibf1, const struct InvertibleBloomFilter *ibf2)
 {
-  int i;
+  uint64_t *k1 = &ibf1->key_sum[0].key_val;
+  const uint64_t *k2 = &ibf2->key_sum[0].key_val;
+  uint32_t *h1 = &ibf1->key_hash_sum[0].key_hash_val;
+  const uint32_t *h2 = &ibf2->key_hash_sum[0].key_hash_val;
+  int8_t *c1 = &ibf1->count[0].count_val;
+  const int8_t *c2 = &ibf2->count[0].count_val;
+  uint32_t size = ibf1->size;
+  uint32_t i;
 
   GNUNET_assert (ibf1->size == ibf2->size);
   GNUNET_assert (ibf1->hash_num == ibf2->hash_num);
-
-  for (i = 0; i < ibf1->size; i++)
-  {
-    ibf1->count[i].count_val -= ibf2->count[i].count_val;
-    ibf1->key_hash_sum[i].key_hash_val ^= ibf2->key_hash_sum[i].key_hash_val;
-    ibf1->key_sum[i].key_val ^= ibf2->key_sum[i].key_val;
-  }
+  GNUNET_assert (ibf1->salt == ibf2->salt);
+  ibf1->candidates_valid = GNUNET_NO;
+  /* one simple loop per array, so the compiler can vectorize them */
+  for (i = 0; i < size; i++)
+    k1[i] ^= k2[i];
+  for (i = 0; i < size; i++)
+    h1[i] ^= h2[i];
+  for (i = 0; i < size; i++)
+    c1[i] -= c2[i];
 }
 
 
@@ -347,12 +425,13 @@ struct InvertibleBloomFilter *
 ibf_dup (const struct InvertibleBloomFilter *ibf)
 {
   struct InvertibleBloomFilter *copy;
-  copy = GNUNET_malloc (sizeof *copy);
+  copy = GNUNET_new (struct InvertibleBloomFilter);
   copy->hash_num = ibf->hash_num;
   copy->size = ibf->size;
-  copy->key_hash_sum = GNUNET_memdup (ibf->key_hash_sum, ibf->size * sizeof (struct IBF_KeyHash));
-  copy->key_sum = GNUNET_memdup (ibf->key_sum, ibf->size * sizeof (struct IBF_Key));
-  copy->count = GNUNET_memdup (ibf->count, ibf->size * sizeof (struct IBF_Count));
+  copy->salt = ibf->salt;
+  ibf_set_arrays (copy, GNUNET_malloc_large (ibf->size * IBF_BUCKET_SIZE));
+  GNUNET_assert (NULL != copy->key_sum);
+  memcpy (copy->key_sum, ibf->key_sum, ibf->size * IBF_BUCKET_SIZE);
   return copy;
 }
 
@@ -367,8 +446,9 @@ void
 ibf_destroy (struct InvertibleBloomFilter *ibf)
 {
   GNUNET_free (ibf->key_sum);
-  GNUNET_free (ibf->key_hash_sum);
-  GNUNET_free (ibf->count);
+  GNUNET_array_grow (ibf->candidates,
+                     ibf->candidates_size,
+                     0);
   GNUNET_free (ibf);
 }
 
@@ -78,6 +78,11 @@ struct IBF_Count
  *
  * An IBF is a counting bloom filter that has the ability to restore
  * the hashes of its stored elements with high probability.
+ *
+ * The buckets are stored as a structure of arrays (in the same order
+ * as on the wire), all in one allocation, so that operations on whole
+ * IBFs are simple loops over contiguous memory that the compiler
+ * can vectorize.
  */
 struct InvertibleBloomFilter
 {
@@ -92,9 +97,16 @@ struct InvertibleBloomFilter
    */
   uint8_t hash_num;
 
+  /**
+   * Salt for mapping keys to cells.  IBFs with different salts
+   * hash the same key into independent cells.  0 by default.
+   */
+  uint32_t salt;
+
   /**
    * Xor sums of the elements' keys, used to identify the elements.
-   * Array of 'size' elements.
+   * Array of 'size' elements.  Start of the allocation holding all
+   * three arrays.
    */
   struct IBF_Key *key_sum;
 
@@ -110,6 +122,29 @@ struct InvertibleBloomFilter
    * Array of 'size' elements.
    */
   struct IBF_Count *count;
+
+  /**
+   * Buckets that may be pure, to be checked by #ibf_decode().
+   * Only valid if @e candidates_valid is #GNUNET_YES.
+   */
+  uint32_t *candidates;
+
+  /**
+   * Number of entries in @e candidates.
+   */
+  unsigned int candidates_len;
+
+  /**
+   * Number of entries allocated for @e candidates.
+   */
+  unsigned int candidates_size;
+
+  /**
+   * #GNUNET_YES if @e candidates contains all pure buckets, i.e. if
+   * the IBF was not modified (other than by #ibf_decode()) since the
+   * candidates were collected.
+   */
+  int candidates_valid;
 };
 
 
@@ -192,7 +227,7 @@ ibf_remove (struct InvertibleBloomFilter *ibf, struct IBF_Key key);
 
 /**
  * Subtract ibf2 from ibf1, storing the result in ibf1.
- * The two IBF's must have the same parameters size and hash_num.
+ * The two IBF's must have the same parameters size, hash_num and salt.
  *
  * @param ibf1 IBF that is subtracted from
  * @param ibf2 IBF that will be subtracted from ibf1
@@ -0,0 +1,153 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file set/perf_ibf.c
+ * @brief measure performance of the invertible bloom filter
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_benchmark_lib.h"
+#include "ibf.h"
+
+/**
+ * Number of elements both sets have in common.
+ */
+#define COMMON (64 * 1024)
+
+/**
+ * Number of elements only in one of the sets (each).
+ */
+#define DIFF 128
+
+/**
+ * Number of buckets of the IBFs, enough to decode 2 * #DIFF elements.
+ */
+#define IBF_SIZE 1024
+
+/**
+ * Number of hash functions, as used by the set service.
+ */
+#define IBF_HASH_NUM 4
+
+/**
+ * Keys of the elements, the first #COMMON are in both sets,
+ * followed by #DIFF for each of the two sets.
+ */
+static struct IBF_Key *keys;
+
+/**
+ * IBF of the first set.
+ */
+static struct InvertibleBloomFilter *ibf_a;
+
+/**
+ * IBF of the second set.
+ */
+static struct InvertibleBloomFilter *ibf_b;
+
+
+/**
+ * Create an IBF of a set.
+ *
+ * @param off offset of the elements only in this set in #keys
+ * @return the IBF
+ */
+static struct InvertibleBloomFilter *
+create_ibf (unsigned int off)
+{
+  struct InvertibleBloomFilter *ibf;
+  unsigned int i;
+
+  ibf = ibf_create (IBF_SIZE,
+                    IBF_HASH_NUM);
+  for (i=0;i<COMMON;i++)
+    ibf_insert (ibf,
+                keys[i]);
+  for (i=0;i<DIFF;i++)
+    ibf_insert (ibf,
+                keys[off + i]);
+  return ibf;
+}
+
+
+static uint64_t
+perfInsert (void *cls)
+{
+  ibf_destroy (create_ibf (COMMON));
+  return COMMON + DIFF;
+}
+
+
+static uint64_t
+perfDecode (void *cls)
+{
+  struct InvertibleBloomFilter *ibf;
+  struct IBF_Key key;
+  int side;
+  int res;
+  uint64_t decoded;
+
+  ibf = ibf_dup (ibf_a);
+  ibf_subtract (ibf,
+                ibf_b);
+  decoded = 0;
+  while (GNUNET_YES == (res = ibf_decode (ibf,
+                                          &side,
+                                          &key)))
+    decoded++;
+  GNUNET_break (GNUNET_NO == res);
+  GNUNET_break (2 * DIFF == decoded);
+  ibf_destroy (ibf);
+  return decoded;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_BENCHMARK_Suite *suite;
+  struct GNUNET_HashCode hash;
+  unsigned int i;
+
+  keys = GNUNET_new_array (COMMON + 2 * DIFF,
+                           struct IBF_Key);
+  for (i=0;i<COMMON + 2 * DIFF;i++)
+  {
+    GNUNET_CRYPTO_hash (&i,
+                        sizeof (i),
+                        &hash);
+    keys[i] = ibf_key_from_hashcode (&hash);
+  }
+  ibf_a = create_ibf (COMMON);
+  ibf_b = create_ibf (COMMON + DIFF);
+  suite = GNUNET_BENCHMARK_suite_create ("SET", "perf_ibf");
+  GNUNET_BENCHMARK_run (suite, "IBF insert", "elements", 10,
+                        &perfInsert, NULL);
+  GNUNET_BENCHMARK_run (suite, "IBF subtract/decode", "elements", 10,
+                        &perfDecode, NULL);
+  ibf_destroy (ibf_a);
+  ibf_destroy (ibf_b);
+  GNUNET_free (keys);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
+}
+
+/* end of perf_ibf.c */
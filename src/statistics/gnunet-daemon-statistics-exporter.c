@@ -0,0 +1,823 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file statistics/gnunet-daemon-statistics-exporter.c
+ * @brief HTTP server exporting all statistics in OpenMetrics
+ *        (Prometheus) text format
+ * @author Christian Grothoff
+ *
+ * The daemon periodically fetches a snapshot of all values from the
+ * statistics service and serves it to scrapers from memory.  Plain
+ * values are exported as gauges; values following the histogram
+ * naming convention of #GNUNET_STATISTICS_observe() are combined
+ * into histograms.
+ */
+#include "platform.h"
+#include <microhttpd.h>
+#include "gnunet_util_lib.h"
+#include "gnunet_statistics_service.h"
+
+/**
+ * Number of histogram buckets: one per power of two, plus "+Inf".
+ */
+#define HISTOGRAM_BUCKETS 65
+
+/**
+ * Content type of our responses.
+ */
+#define OPENMETRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+
+/**
+ * Values of a histogram collected while iterating over the
+ * statistics.
+ */
+struct Histogram
+{
+  /**
+   * Subsystem the histogram belongs to.
+   */
+  char *subsystem;
+
+  /**
+   * Name of the histogram (without suffix).
+   */
+  char *name;
+
+  /**
+   * Sum of all observations.
+   */
+  uint64_t sum;
+
+  /**
+   * Number of observations.
+   */
+  uint64_t count;
+
+  /**
+   * Number of observations per bucket (not cumulative); bucket
+   * 'b' is for values up to 2^b, the last bucket for larger values.
+   */
+  uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+
+/**
+ * Growing text buffer.
+ */
+struct TextBuffer
+{
+  /**
+   * The text, NOT 0-terminated.
+   */
+  char *buf;
+
+  /**
+   * Number of bytes used in @e buf.
+   */
+  size_t off;
+
+  /**
+   * Number of bytes allocated for @e buf.
+   */
+  unsigned int size;
+};
+
+
+/**
+ * Our configuration.
+ */
+static const struct GNUNET_CONFIGURATION_Handle *cfg;
+
+/**
+ * Handle to the statistics service.
+ */
+static struct GNUNET_STATISTICS_Handle *stats;
+
+/**
+ * Our HTTP server.
+ */
+static struct MHD_Daemon *daemon_handle;
+
+/**
+ * Task running the HTTP server.
+ */
+static struct GNUNET_SCHEDULER_Task *http_task;
+
+/**
+ * Task fetching the next snapshot.
+ */
+static struct GNUNET_SCHEDULER_Task *refresh_task;
+
+/**
+ * Snapshot request in progress, or NULL.
+ */
+static struct GNUNET_STATISTICS_GetHandle *get_handle;
+
+/**
+ * Response with the last complete snapshot, or NULL.
+ */
+static struct MHD_Response *response;
+
+/**
+ * Histograms of the snapshot in progress, hash of subsystem and
+ * name to `struct Histogram`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *histograms;
+
+/**
+ * Gauges of the snapshot in progress.
+ */
+static struct TextBuffer gauges;
+
+/**
+ * How often do we fetch a new snapshot?
+ */
+static struct GNUNET_TIME_Relative refresh_frequency;
+
+
+/**
+ * Append formatted text to a buffer.
+ *
+ * @param tb buffer to append to
+ * @param format format string
+ * @param ... arguments for @a format
+ */
+static void
+tb_printf (struct TextBuffer *tb,
+           const char *format,
+           ...)
+{
+  va_list va;
+  int ret;
+
+  while (1)
+  {
+    va_start (va, format);
+    ret = vsnprintf (&tb->buf[tb->off],
+                     tb->size - tb->off,
+                     format,
+                     va);
+    va_end (va);
+    GNUNET_assert (0 <= ret);
+    if (tb->off + ret < tb->size)
+      break;
+    GNUNET_array_grow (tb->buf,
+                       tb->size,
+                       GNUNET_MAX (1024, 2 * (tb->off + ret + 1)));
+  }
+  tb->off += ret;
+}
+
+
+/**
+ * Append a label value, escaped as required by OpenMetrics.
+ *
+ * @param tb buffer to append to
+ * @param value label value to append
+ */
+static void
+tb_label (struct TextBuffer *tb,
+          const char *value)
+{
+  for (; '\0' != *value; value++)
+  {
+    switch (*value)
+    {
+    case '\\':
+      tb_printf (tb, "\\\\");
+      break;
+    case '"':
+      tb_printf (tb, "\\\"");
+      break;
+    case '\n':
+      tb_printf (tb, "\\n");
+      break;
+    default:
+      tb_printf (tb, "%c", *value);
+      break;
+    }
+  }
+}
+
+
+/**
+ * Append the labels identifying a value.
+ *
+ * @param tb buffer to append to
+ * @param subsystem subsystem of the value
+ * @param name name of the value
+ */
+static void
+tb_labels (struct TextBuffer *tb,
+           const char *subsystem,
+           const char *name)
+{
+  tb_printf (tb, "subsystem=\"");
+  tb_label (tb, subsystem);
+  tb_printf (tb, "\",name=\"");
+  tb_label (tb, name);
+  tb_printf (tb, "\"");
+}
+
+
+/**
+ * Find or create the histogram for the given value.
+ *
+ * @param subsystem subsystem of the histogram
+ * @param name value name
+ * @param nlen length of the histogram name within @a name
+ * @return histogram entry
+ */
+static struct Histogram *
+get_histogram (const char *subsystem,
+               const char *name,
+               size_t nlen)
+{
+  struct GNUNET_HashContext *hctx;
+  struct GNUNET_HashCode hc;
+  struct Histogram *hg;
+
+  hctx = GNUNET_CRYPTO_hash_context_start ();
+  GNUNET_CRYPTO_hash_context_read (hctx, subsystem, strlen (subsystem) + 1);
+  GNUNET_CRYPTO_hash_context_read (hctx, name, nlen);
+  GNUNET_CRYPTO_hash_context_finish (hctx, &hc);
+  hg = GNUNET_CONTAINER_multihashmap_get (histograms, &hc);
+  if (NULL != hg)
+    return hg;
+  hg = GNUNET_new (struct Histogram);
+  hg->subsystem = GNUNET_strdup (subsystem);
+  hg->name = GNUNET_strndup (name, nlen);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (histograms,
+                                                    &hc,
+                                                    hg,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  return hg;
+}
+
+
+/**
+ * Check if the given value is part of a histogram, and if so
+ * add it to the histogram.
+ *
+ * @param subsystem subsystem of the value
+ * @param name name of the value
+ * @param value the value
+ * @return #GNUNET_YES if the value was part of a histogram
+ */
+static int
+add_histogram_value (const char *subsystem,
+                     const char *name,
+                     uint64_t value)
+{
+  const char *suffix;
+  unsigned long long bound;
+  char dummy;
+  unsigned int b;
+  size_t nlen;
+
+  nlen = strlen (name);
+  if ( (nlen > strlen (GNUNET_STATISTICS_HISTOGRAM_SUM)) &&
+       (0 == strcmp (&name[nlen - strlen (GNUNET_STATISTICS_HISTOGRAM_SUM)],
+                     GNUNET_STATISTICS_HISTOGRAM_SUM)) )
+  {
+    get_histogram (subsystem, name,
+                   nlen - strlen (GNUNET_STATISTICS_HISTOGRAM_SUM))->sum = value;
+    return GNUNET_YES;
+  }
+  if ( (nlen > strlen (GNUNET_STATISTICS_HISTOGRAM_COUNT)) &&
+       (0 == strcmp (&name[nlen - strlen (GNUNET_STATISTICS_HISTOGRAM_COUNT)],
+                     GNUNET_STATISTICS_HISTOGRAM_COUNT)) )
+  {
+    get_histogram (subsystem, name,
+                   nlen - strlen (GNUNET_STATISTICS_HISTOGRAM_COUNT))->count = value;
+    return GNUNET_YES;
+  }
+  if (NULL == (suffix = strstr (name, GNUNET_STATISTICS_HISTOGRAM_BUCKET)))
+    return GNUNET_NO;
+  while (NULL != strstr (suffix + 1, GNUNET_STATISTICS_HISTOGRAM_BUCKET))
+    suffix = strstr (suffix + 1, GNUNET_STATISTICS_HISTOGRAM_BUCKET);
+  if (0 == strcmp (suffix + strlen (GNUNET_STATISTICS_HISTOGRAM_BUCKET),
+                   "+Inf"))
+  {
+    b = HISTOGRAM_BUCKETS - 1;
+  }
+  else
+  {
+    if (1 != sscanf (suffix + strlen (GNUNET_STATISTICS_HISTOGRAM_BUCKET),
+                     "%llu%c",
+                     &bound,
+                     &dummy))
+      return GNUNET_NO;
+    for (b = 0; b < HISTOGRAM_BUCKETS - 1; b++)
+      if ((1LLU << b) == bound)
+        break;
+    if (HISTOGRAM_BUCKETS - 1 == b)
+      return GNUNET_NO; /* not one of our bounds */
+  }
+  get_histogram (subsystem, name, suffix - name)->buckets[b] = value;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Process a value of the snapshot.
+ *
+ * @param cls NULL
+ * @param subsystem name of subsystem that created the statistic
+ * @param name the name of the datum
+ * @param value the current value
+ * @param is_persistent #GNUNET_YES if the value is persistent
+ * @return #GNUNET_OK to continue
+ */
+static int
+process_value (void *cls,
+               const char *subsystem,
+               const char *name,
+               uint64_t value,
+               int is_persistent)
+{
+  if (GNUNET_YES == add_histogram_value (subsystem, name, value))
+    return GNUNET_OK;
+  tb_printf (&gauges, "gnunet_statistics{");
+  tb_labels (&gauges, subsystem, name);
+  tb_printf (&gauges, "} %llu\n", (unsigned long long) value);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Append a histogram to the output and free it.
+ *
+ * @param cls the `struct TextBuffer`
+ * @param key unused
+ * @param value the `struct Histogram`
+ * @return #GNUNET_OK to continue
+ */
+static int
+write_histogram (void *cls,
+                 const struct GNUNET_HashCode *key,
+                 void *value)
+{
+  struct TextBuffer *tb = cls;
+  struct Histogram *hg = value;
+  uint64_t cum;
+  unsigned int b;
+
+  cum = 0;
+  for (b = 0; b < HISTOGRAM_BUCKETS - 1; b++)
+  {
+    if (0 == hg->buckets[b])
+      continue;
+    cum += hg->buckets[b];
+    tb_printf (tb, "gnunet_statistics_histogram_bucket{");
+    tb_labels (tb, hg->subsystem, hg->name);
+    tb_printf (tb, ",le=\"%llu\"} %llu\n",
+               (unsigned long long) (1LLU << b),
+               (unsigned long long) cum);
+  }
+  cum += hg->buckets[HISTOGRAM_BUCKETS - 1];
+  tb_printf (tb, "gnunet_statistics_histogram_bucket{");
+  tb_labels (tb, hg->subsystem, hg->name);
+  tb_printf (tb, ",le=\"+Inf\"} %llu\n", (unsigned long long) cum);
+  tb_printf (tb, "gnunet_statistics_histogram_count{");
+  tb_labels (tb, hg->subsystem, hg->name);
+  tb_printf (tb, "} %llu\n", (unsigned long long) hg->count);
+  tb_printf (tb, "gnunet_statistics_histogram_sum{");
+  tb_labels (tb, hg->subsystem, hg->name);
+  tb_printf (tb, "} %llu\n", (unsigned long long) hg->sum);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Free a histogram.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct Histogram`
+ * @return #GNUNET_OK to continue
+ */
+static int
+free_histogram (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  struct Histogram *hg = value;
+
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (histograms,
+                                                       key,
+                                                       hg));
+  GNUNET_free (hg->subsystem);
+  GNUNET_free (hg->name);
+  GNUNET_free (hg);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Fetch a new snapshot from the statistics service.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+do_refresh (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * The snapshot is complete; turn it into the response we serve.
+ *
+ * @param cls NULL
+ * @param success #GNUNET_OK if the snapshot is complete
+ */
+static void
+snapshot_done (void *cls,
+               int success)
+{
+  struct TextBuffer tb;
+
+  get_handle = NULL;
+  if (GNUNET_OK == success)
+  {
+    memset (&tb, 0, sizeof (tb));
+    tb_printf (&tb,
+               "# TYPE gnunet_statistics gauge\n"
+               "# HELP gnunet_statistics Value of a GNUnet statistic.\n");
+    if (0 != gauges.off)
+    {
+      GNUNET_array_grow (tb.buf, tb.size, tb.off + gauges.off + 1);
+      memcpy (&tb.buf[tb.off], gauges.buf, gauges.off);
+      tb.off += gauges.off;
+    }
+    tb_printf (&tb,
+               "# TYPE gnunet_statistics_histogram histogram\n"
+               "# HELP gnunet_statistics_histogram Distribution of a GNUnet statistic.\n");
+    GNUNET_CONTAINER_multihashmap_iterate (histograms,
+                                           &write_histogram,
+                                           &tb);
+    tb_printf (&tb, "# EOF\n");
+    if (NULL != response)
+      MHD_destroy_response (response);
+    response = MHD_create_response_from_buffer (tb.off,
+                                                tb.buf,
+                                                MHD_RESPMEM_MUST_FREE);
+    MHD_add_response_header (response,
+                             MHD_HTTP_HEADER_CONTENT_TYPE,
+                             OPENMETRICS_CONTENT_TYPE);
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to obtain statistics snapshot, serving old values\n"));
+  }
+  GNUNET_CONTAINER_multihashmap_iterate (histograms,
+                                         &free_histogram,
+                                         NULL);
+  gauges.off = 0;
+  refresh_task = GNUNET_SCHEDULER_add_delayed (refresh_frequency,
+                                               &do_refresh,
+                                               NULL);
+}
+
+
+/**
+ * Fetch a new snapshot from the statistics service.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+do_refresh (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  refresh_task = NULL;
+  get_handle = GNUNET_STATISTICS_get (stats,
+                                      NULL,
+                                      NULL,
+                                      refresh_frequency,
+                                      &snapshot_done,
+                                      &process_value,
+                                      NULL);
+  if (NULL == get_handle)
+    refresh_task = GNUNET_SCHEDULER_add_delayed (refresh_frequency,
+                                                 &do_refresh,
+                                                 NULL);
+}
+
+
+/**
+ * Main request handler.
+ *
+ * @param cls unused
+ * @param connection MHD connection handle
+ * @param url the requested url
+ * @param method the HTTP method used
+ * @param version the HTTP version string
+ * @param upload_data the data being uploaded (excluding headers)
+ * @param upload_data_size set initially to the size of the
+ *        @a upload_data provided
+ * @param con_cls pointer to location where we store per-request state
+ * @return #MHD_YES if the connection was handled successfully,
+ *         #MHD_NO if the socket must be closed due to a serios
+ *         error while handling the request
+ */
+static int
+access_handler_callback (void *cls,
+                         struct MHD_Connection *connection,
+                         const char *url,
+                         const char *method,
+                         const char *version,
+                         const char *upload_data,
+                         size_t *upload_data_size,
+                         void **con_cls)
+{
+  static int dummy;
+  struct MHD_Response *r;
+  int ret;
+
+  if (0 != strcmp (method, MHD_HTTP_METHOD_GET))
+    return MHD_NO;
+  if (NULL == *con_cls)
+  {
+    *con_cls = &dummy;
+    return MHD_YES;
+  }
+  if (0 != *upload_data_size)
+    return MHD_NO;              /* do not support upload data */
+  if (NULL != response)
+    return MHD_queue_response (connection, MHD_HTTP_OK, response);
+  /* no snapshot yet */
+  r = MHD_create_response_from_buffer (0, NULL,
+                                       MHD_RESPMEM_PERSISTENT);
+  ret = MHD_queue_response (connection,
+                            MHD_HTTP_SERVICE_UNAVAILABLE,
+                            r);
+  MHD_destroy_response (r);
+  return ret;
+}
+
+
+/**
+ * Function that queries MHD's select sets and
+ * starts the task waiting for them.
+ */
+static void
+prepare_daemon (void);
+
+
+/**
+ * Call MHD to process pending requests and then go back
+ * and schedule the next run.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_daemon (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  http_task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  GNUNET_assert (MHD_YES == MHD_run (daemon_handle));
+  prepare_daemon ();
+}
+
+
+/**
+ * Function that queries MHD's select sets and
+ * starts the task waiting for them.
+ */
+static void
+prepare_daemon ()
+{
+  fd_set rs;
+  fd_set ws;
+  fd_set es;
+  struct GNUNET_NETWORK_FDSet *wrs;
+  struct GNUNET_NETWORK_FDSet *wws;
+  int max;
+  MHD_UNSIGNED_LONG_LONG timeout;
+  struct GNUNET_TIME_Relative tv;
+
+  FD_ZERO (&rs);
+  FD_ZERO (&ws);
+  FD_ZERO (&es);
+  wrs = GNUNET_NETWORK_fdset_create ();
+  wws = GNUNET_NETWORK_fdset_create ();
+  max = -1;
+  GNUNET_assert (MHD_YES == MHD_get_fdset (daemon_handle, &rs, &ws, &es, &max));
+  if (MHD_YES == MHD_get_timeout (daemon_handle, &timeout))
+    tv.rel_value_us = (uint64_t) timeout * 1000LL;
+  else
+    tv = GNUNET_TIME_UNIT_FOREVER_REL;
+  GNUNET_NETWORK_fdset_copy_native (wrs, &rs, max + 1);
+  GNUNET_NETWORK_fdset_copy_native (wws, &ws, max + 1);
+  http_task =
+      GNUNET_SCHEDULER_add_select (GNUNET_SCHEDULER_PRIORITY_DEFAULT,
+                                   tv, wrs, wws,
+                                   &run_daemon, NULL);
+  GNUNET_NETWORK_fdset_destroy (wrs);
+  GNUNET_NETWORK_fdset_destroy (wws);
+}
+
+
+/**
+ * Last task run during shutdown.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+cleaning_task (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  if (NULL != http_task)
+  {
+    GNUNET_SCHEDULER_cancel (http_task);
+    http_task = NULL;
+  }
+  if (NULL != refresh_task)
+  {
+    GNUNET_SCHEDULER_cancel (refresh_task);
+    refresh_task = NULL;
+  }
+  if (NULL != get_handle)
+  {
+    GNUNET_STATISTICS_get_cancel (get_handle);
+    get_handle = NULL;
+  }
+  if (NULL != daemon_handle)
+  {
+    MHD_stop_daemon (daemon_handle);
+    daemon_handle = NULL;
+  }
+  if (NULL != response)
+  {
+    MHD_destroy_response (response);
+    response = NULL;
+  }
+  if (NULL != histograms)
+  {
+    GNUNET_CONTAINER_multihashmap_iterate (histograms,
+                                           &free_histogram,
+                                           NULL);
+    GNUNET_CONTAINER_multihashmap_destroy (histograms);
+    histograms = NULL;
+  }
+  GNUNET_array_grow (gauges.buf, gauges.size, 0);
+  gauges.off = 0;
+  if (NULL != stats)
+  {
+    GNUNET_STATISTICS_destroy (stats, GNUNET_NO);
+    stats = NULL;
+  }
+}
+
+
+/**
+ * Main function that will be run.
+ *
+ * @param cls closure
+ * @param args remaining command-line arguments
+ * @param cfgfile name of the configuration file used (for saving, can be NULL)
+ * @param c configuration
+ */
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *c)
+{
+  unsigned long long port;
+  char *bind_to;
+  struct sockaddr_in v4;
+
+  cfg = c;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "statistics-exporter",
+                                             "HTTPPORT",
+                                             &port))
+  {
+    GNUNET_log_config_missing (GNUNET_ERROR_TYPE_ERROR,
+                               "statistics-exporter",
+                               "HTTPPORT");
+    return;
+  }
+  if ( (0 == port) ||
+       (port > UINT16_MAX) )
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                               "statistics-exporter",
+                               "HTTPPORT",
+                               _("Invalid port number"));
+    return;
+  }
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "statistics-exporter",
+                                           "REFRESH_FREQUENCY",
+                                           &refresh_frequency))
+    refresh_frequency = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 15);
+  memset (&v4, 0, sizeof (v4));
+  v4.sin_family = AF_INET;
+  v4.sin_port = htons ((uint16_t) port);
+#if HAVE_SOCKADDR_IN_SIN_LEN
+  v4.sin_len = sizeof (v4);
+#endif
+  v4.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  if (GNUNET_OK ==
+      GNUNET_CONFIGURATION_get_value_string (cfg,
+                                             "statistics-exporter",
+                                             "BINDTO",
+                                             &bind_to))
+  {
+    if (1 != inet_pton (AF_INET, bind_to, &v4.sin_addr))
+    {
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_ERROR,
+                                 "statistics-exporter",
+                                 "BINDTO",
+                                 _("Not an IPv4 address"));
+      GNUNET_free (bind_to);
+      return;
+    }
+    GNUNET_free (bind_to);
+  }
+  daemon_handle = MHD_start_daemon (MHD_USE_DEBUG,
+                                    (uint16_t) port,
+                                    NULL, NULL,
+                                    &access_handler_callback, NULL,
+                                    MHD_OPTION_CONNECTION_LIMIT,
+                                    (unsigned int) 16,
+                                    MHD_OPTION_CONNECTION_TIMEOUT,
+                                    (unsigned int) 16,
+                                    MHD_OPTION_SOCK_ADDR,
+                                    (struct sockaddr *) &v4,
+                                    MHD_OPTION_END);
+  if (NULL == daemon_handle)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                _("Could not start statistics exporter HTTP server on port %u\n"),
+                (unsigned int) port);
+    return;
+  }
+  stats = GNUNET_STATISTICS_create ("statistics-exporter", cfg);
+  histograms = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
+  prepare_daemon ();
+  refresh_task = GNUNET_SCHEDULER_add_now (&do_refresh, NULL);
+  GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
+                                &cleaning_task,
+                                NULL);
+}
+
+
+/**
+ * The main function for the statistics exporter.
+ *
+ * @param argc number of arguments from the command line
+ * @param argv command line arguments
+ * @return 0 ok, 1 on error
+ */
+int
+main (int argc, char *const *argv)
+{
+  static const struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+  int ret;
+
+  if (GNUNET_OK != GNUNET_STRINGS_get_utf8_args (argc, argv, &argc, &argv))
+    return 2;
+  ret =
+      (GNUNET_OK ==
+       GNUNET_PROGRAM_run (argc, argv, "gnunet-daemon-statistics-exporter",
+                           _("Export GNUnet statistics in OpenMetrics format via HTTP"),
+                           options, &run, NULL)) ? 0 : 1;
+  GNUNET_free ((void*) argv);
+  return ret;
+}
+
+/* end of gnunet-daemon-statistics-exporter.c */
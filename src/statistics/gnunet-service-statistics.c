@@ -35,6 +35,13 @@
 #include "gnunet_time_lib.h"
 #include "statistics.h"
 
+/**
+ * Minimum time between two rounds of watch notifications.  Changes
+ * to watched values within this interval are coalesced, so a client
+ * watching a busy counter only gets its latest value.
+ */
+#define WATCH_NOTIFY_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
 /**
  * Watch entry.
  */
@@ -118,6 +125,16 @@ struct StatsEntry
    */
   struct WatchEntry *we_tail;
 
+  /**
+   * Entries with pending watch notifications are kept in a DLL.
+   */
+  struct StatsEntry *next_pending;
+
+  /**
+   * Entries with pending watch notifications are kept in a DLL.
+   */
+  struct StatsEntry *prev_pending;
+
   /**
    * Our value.
    */
@@ -139,6 +156,11 @@ struct StatsEntry
    */
   int set;
 
+  /**
+   * #GNUNET_YES if this entry is in the pending notification DLL.
+   */
+  int notify_pending;
+
 };
 
 
@@ -168,6 +190,11 @@ struct SubsystemEntry
    */
   struct StatsEntry *stat_tail;
 
+  /**
+   * Values kept for this subsystem, by hash of their name.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *stat_map;
+
   /**
    * Name of the subsystem this entry is for, allocated at
    * the end of this struct, do not free().
@@ -177,6 +204,30 @@ struct SubsystemEntry
 };
 
 
+/**
+ * A batch of values being transmitted in response to a GET.
+ */
+struct ValueBatch
+{
+  /**
+   * Client receiving the values.
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Number of bytes used in @e buf (including the header).
+   */
+  size_t off;
+
+  /**
+   * Buffer with a #GNUNET_MESSAGE_TYPE_STATISTICS_VALUES message
+   * followed by the `struct GNUNET_STATISTICS_ReplyMessage`s.
+   */
+  char buf[GNUNET_SERVER_MAX_MESSAGE_SIZE - 1];
+
+};
+
+
 /**
  * Client entry.
  */
@@ -215,6 +266,31 @@ static struct SubsystemEntry *sub_head;
  */
 static struct SubsystemEntry *sub_tail;
 
+/**
+ * Map from the hash of the subsystem name to the `struct SubsystemEntry`.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *sub_map;
+
+/**
+ * Head of DLL of entries with pending watch notifications.
+ */
+static struct StatsEntry *pending_head;
+
+/**
+ * Tail of DLL of entries with pending watch notifications.
+ */
+static struct StatsEntry *pending_tail;
+
+/**
+ * Task transmitting pending watch notifications, or NULL.
+ */
+static struct GNUNET_SCHEDULER_Task *notify_task;
+
+/**
+ * When did we last transmit watch notifications?
+ */
+static struct GNUNET_TIME_Absolute last_notify;
+
 /**
  * Number of connected clients.
  */
@@ -338,6 +414,28 @@ load (struct GNUNET_SERVER_Handle *server)
 }
 
 
+/**
+ * Remove a subsystem entry from the DLL and the map.  The caller
+ * must free the entry.
+ *
+ * @param se subsystem entry to remove
+ */
+static void
+remove_subsystem_entry (struct SubsystemEntry *se)
+{
+  struct GNUNET_HashCode hc;
+
+  GNUNET_CONTAINER_DLL_remove (sub_head,
+                               sub_tail,
+                               se);
+  GNUNET_CRYPTO_hash (se->service, strlen (se->service), &hc);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (sub_map,
+                                                       &hc,
+                                                       se));
+}
+
+
 /**
  * Write persistent statistics to disk.
  */
@@ -370,9 +468,7 @@ save ()
   total = 0;
   while (NULL != (se = sub_head))
   {
-    GNUNET_CONTAINER_DLL_remove (sub_head,
-                                 sub_tail,
-                                 se);
+    remove_subsystem_entry (se);
     slen = strlen (se->service) + 1;
     while (NULL != (pos = se->stat_head))
     {
@@ -417,6 +513,7 @@ save ()
       }
       GNUNET_free (pos);
     }
+    GNUNET_CONTAINER_multihashmap_destroy (se->stat_map);
     GNUNET_free (se);
   }
   if (NULL != wh)
@@ -440,13 +537,35 @@ save ()
 
 
 /**
- * Transmit the given stats value.
+ * Transmit the values collected in the given batch (if any).
  *
- * @param client receiver of the value
+ * @param vb batch to transmit, reset to empty afterwards
+ */
+static void
+flush_batch (struct ValueBatch *vb)
+{
+  struct GNUNET_MessageHeader *hdr;
+
+  if (sizeof (struct GNUNET_MessageHeader) >= vb->off)
+    return;
+  hdr = (struct GNUNET_MessageHeader *) vb->buf;
+  hdr->type = htons (GNUNET_MESSAGE_TYPE_STATISTICS_VALUES);
+  hdr->size = htons ((uint16_t) vb->off);
+  GNUNET_SERVER_notification_context_unicast (nc, vb->client, hdr,
+                                              GNUNET_NO);
+  vb->off = sizeof (struct GNUNET_MessageHeader);
+}
+
+
+/**
+ * Add the given stats value to the batch, transmitting the
+ * batch first if the value does not fit.
+ *
+ * @param vb batch to add the value to
  * @param e value to transmit
  */
 static void
-transmit (struct GNUNET_SERVER_Client *client,
+transmit (struct ValueBatch *vb,
           const struct StatsEntry *e)
 {
   struct GNUNET_STATISTICS_ReplyMessage *m;
@@ -455,8 +574,11 @@ transmit (struct GNUNET_SERVER_Client *client,
   size = sizeof (struct GNUNET_STATISTICS_ReplyMessage) +
     strlen (e->subsystem->service) + 1 +
     strlen (e->name) + 1;
-  GNUNET_assert (size < GNUNET_SERVER_MAX_MESSAGE_SIZE);
-  m = GNUNET_malloc (size);
+  GNUNET_assert (size + sizeof (struct GNUNET_MessageHeader) <= sizeof (vb->buf));
+  if (vb->off + size > sizeof (vb->buf))
+    flush_batch (vb);
+  m = (struct GNUNET_STATISTICS_ReplyMessage *) &vb->buf[vb->off];
+  vb->off += size;
   m->header.type = htons (GNUNET_MESSAGE_TYPE_STATISTICS_VALUE);
   m->header.size = htons (size);
   m->uid = htonl (e->uid);
@@ -476,9 +598,6 @@ transmit (struct GNUNET_SERVER_Client *client,
               e->name,
               e->persistent,
               e->value);
-  GNUNET_SERVER_notification_context_unicast (nc, client, &m->header,
-                                              GNUNET_NO);
-  GNUNET_free (m);
 }
 
 
@@ -512,79 +631,13 @@ make_client_entry (struct GNUNET_SERVER_Client *client)
 
 
 /**
- * Handle GET-message.
- *
- * @param cls closure
- * @param client identification of the client
- * @param message the actual message
- * @return #GNUNET_OK to keep the connection open,
- *         #GNUNET_SYSERR to close it (signal serious error)
- */
-static void
-handle_get (void *cls,
-            struct GNUNET_SERVER_Client *client,
-            const struct GNUNET_MessageHeader *message)
-{
-  struct GNUNET_MessageHeader end;
-  const char *service;
-  const char *name;
-  size_t slen;
-  size_t nlen;
-  struct SubsystemEntry *se;
-  struct StatsEntry *pos;
-  size_t size;
-
-  if (NULL == make_client_entry (client))
-    return; /* new client during shutdown */
-  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
-  if (size !=
-      GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
-                                      size,
-                                      2,
-                                      &service,
-                                      &name))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client,
-                                GNUNET_SYSERR);
-    return;
-  }
-  slen = strlen (service);
-  nlen = strlen (name);
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Received request for statistics on `%s:%s'\n",
-              slen ? service : "*",
-              nlen ? name : "*");
-  for (se = sub_head; NULL != se; se = se->next)
-  {
-    if (! ( (0 == slen) ||
-            (0 == strcmp (service, se->service))) )
-      continue;
-    for (pos = se->stat_head; NULL != pos; pos = pos->next)
-    {
-      if  (! ( (0 == nlen) ||
-               (0 == strcmp (name, pos->name))) )
-        continue;
-      transmit (client, pos);
-    }
-  }
-  end.size = htons (sizeof (struct GNUNET_MessageHeader));
-  end.type = htons (GNUNET_MESSAGE_TYPE_STATISTICS_END);
-  GNUNET_SERVER_notification_context_unicast (nc,
-                                              client,
-                                              &end,
-                                              GNUNET_NO);
-  GNUNET_SERVER_receive_done (client, GNUNET_OK);
-}
-
-
-/**
- * Notify all clients listening about a change to a value.
+ * Tell all clients watching the given value about its current
+ * value (unless they already know it).
  *
- * @param se value that changed
+ * @param se value to report
  */
 static void
-notify_change (struct StatsEntry *se)
+notify_watchers (struct StatsEntry *se)
 {
   struct GNUNET_STATISTICS_WatchValueMessage wvm;
   struct WatchEntry *pos;
@@ -616,6 +669,62 @@ notify_change (struct StatsEntry *se)
 }
 
 
+/**
+ * Transmit all pending watch notifications.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+do_notify (void *cls,
+           const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct StatsEntry *se;
+
+  notify_task = NULL;
+  last_notify = GNUNET_TIME_absolute_get ();
+  while (NULL != (se = pending_head))
+  {
+    GNUNET_CONTAINER_MDLL_remove (pending,
+                                  pending_head,
+                                  pending_tail,
+                                  se);
+    se->notify_pending = GNUNET_NO;
+    notify_watchers (se);
+  }
+}
+
+
+/**
+ * Notify all clients listening about a change to a value.  Clients
+ * are told at most once per #WATCH_NOTIFY_FREQUENCY; changes in
+ * between are coalesced.
+ *
+ * @param se value that changed
+ */
+static void
+notify_change (struct StatsEntry *se)
+{
+  if (NULL == se->we_head)
+    return;
+  if (GNUNET_NO == se->notify_pending)
+  {
+    GNUNET_CONTAINER_MDLL_insert_tail (pending,
+                                       pending_head,
+                                       pending_tail,
+                                       se);
+    se->notify_pending = GNUNET_YES;
+  }
+  if (NULL != notify_task)
+    return;
+  notify_task
+    = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (GNUNET_TIME_absolute_add (last_notify,
+                                                                                                  WATCH_NOTIFY_FREQUENCY)),
+                                    &do_notify,
+                                    NULL);
+}
+
+
 /**
  * Find the subsystem entry of the given name for the specified client.
  *
@@ -628,6 +737,7 @@ static struct SubsystemEntry *
 find_subsystem_entry (struct ClientEntry *ce,
                       const char *service)
 {
+  struct GNUNET_HashCode hc;
   size_t slen;
   struct SubsystemEntry *se;
 
@@ -639,10 +749,8 @@ find_subsystem_entry (struct ClientEntry *ce,
        (0 != strcmp (service,
                      se->service)) )
   {
-    for (se = sub_head; NULL != se; se = se->next)
-      if (0 == strcmp (service,
-                       se->service))
-        break;
+    GNUNET_CRYPTO_hash (service, strlen (service), &hc);
+    se = GNUNET_CONTAINER_multihashmap_get (sub_map, &hc);
     if (NULL != ce)
       ce->subsystem = se;
   }
@@ -658,15 +766,62 @@ find_subsystem_entry (struct ClientEntry *ce,
           service,
           slen);
   se->service = (const char *) &se[1];
+  se->stat_map = GNUNET_CONTAINER_multihashmap_create (128, GNUNET_NO);
   GNUNET_CONTAINER_DLL_insert (sub_head,
                                sub_tail,
                                se);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multihashmap_put (sub_map,
+                                                    &hc,
+                                                    se,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
   if (NULL != ce)
     ce->subsystem = se;
   return se;
 }
 
 
+/**
+ * Closure for #find_stat_it().
+ */
+struct FindStatContext
+{
+  /**
+   * Name we are looking for.
+   */
+  const char *name;
+
+  /**
+   * Set to the entry once found.
+   */
+  struct StatsEntry *result;
+};
+
+
+/**
+ * Check if a statistics entry with a matching hash is the one
+ * we are looking for.
+ *
+ * @param cls the `struct FindStatContext`
+ * @param key hash of the name
+ * @param value a `struct StatsEntry`
+ * @return #GNUNET_NO if found, #GNUNET_YES to continue
+ */
+static int
+find_stat_it (void *cls,
+              const struct GNUNET_HashCode *key,
+              void *value)
+{
+  struct FindStatContext *fsc = cls;
+  struct StatsEntry *pos = value;
+
+  if (0 != strcmp (fsc->name, pos->name))
+    return GNUNET_YES;
+  fsc->result = pos;
+  return GNUNET_NO;
+}
+
+
 /**
  * Find the statistics entry of the given subsystem.
  *
@@ -678,12 +833,133 @@ static struct StatsEntry *
 find_stat_entry (struct SubsystemEntry *se,
                  const char *name)
 {
+  struct FindStatContext fsc;
+  struct GNUNET_HashCode hc;
+
+  GNUNET_CRYPTO_hash (name, strlen (name), &hc);
+  fsc.name = name;
+  fsc.result = NULL;
+  GNUNET_CONTAINER_multihashmap_get_multiple (se->stat_map,
+                                              &hc,
+                                              &find_stat_it,
+                                              &fsc);
+  return fsc.result;
+}
+
+
+/**
+ * Add a new statistics entry to its subsystem.
+ *
+ * @param se subsystem of the entry
+ * @param pos the new entry
+ */
+static void
+add_stat_entry (struct SubsystemEntry *se,
+                struct StatsEntry *pos)
+{
+  struct GNUNET_HashCode hc;
+
+  GNUNET_CRYPTO_hash (pos->name, strlen (pos->name), &hc);
+  GNUNET_CONTAINER_multihashmap_put (se->stat_map,
+                                     &hc,
+                                     pos,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  GNUNET_CONTAINER_DLL_insert (se->stat_head,
+                               se->stat_tail,
+                               pos);
+}
+
+
+/**
+ * Handle GET-message.
+ *
+ * @param cls closure
+ * @param client identification of the client
+ * @param message the actual message
+ * @return #GNUNET_OK to keep the connection open,
+ *         #GNUNET_SYSERR to close it (signal serious error)
+ */
+static void
+handle_get (void *cls,
+            struct GNUNET_SERVER_Client *client,
+            const struct GNUNET_MessageHeader *message)
+{
+  struct GNUNET_MessageHeader end;
+  struct GNUNET_HashCode hc;
+  struct ValueBatch *vb;
+  const char *service;
+  const char *name;
+  size_t slen;
+  size_t nlen;
+  struct SubsystemEntry *se;
   struct StatsEntry *pos;
+  size_t size;
 
-  for (pos = se->stat_head; NULL != pos; pos = pos->next)
-    if  (0 == strcmp (name, pos->name))
-      return pos;
-  return NULL;
+  if (NULL == make_client_entry (client))
+    return; /* new client during shutdown */
+  size = ntohs (message->size) - sizeof (struct GNUNET_MessageHeader);
+  if (size !=
+      GNUNET_STRINGS_buffer_tokenize ((const char *) &message[1],
+                                      size,
+                                      2,
+                                      &service,
+                                      &name))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client,
+                                GNUNET_SYSERR);
+    return;
+  }
+  slen = strlen (service);
+  nlen = strlen (name);
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Received request for statistics on `%s:%s'\n",
+              slen ? service : "*",
+              nlen ? name : "*");
+  vb = GNUNET_new (struct ValueBatch);
+  vb->client = client;
+  vb->off = sizeof (struct GNUNET_MessageHeader);
+  if (0 != slen)
+  {
+    GNUNET_CRYPTO_hash (service, slen, &hc);
+    se = GNUNET_CONTAINER_multihashmap_get (sub_map, &hc);
+    if (NULL != se)
+    {
+      if (0 != nlen)
+      {
+        if (NULL != (pos = find_stat_entry (se, name)))
+          transmit (vb, pos);
+      }
+      else
+      {
+        for (pos = se->stat_head; NULL != pos; pos = pos->next)
+          transmit (vb, pos);
+      }
+    }
+  }
+  else
+  {
+    for (se = sub_head; NULL != se; se = se->next)
+    {
+      if (0 != nlen)
+      {
+        if (NULL != (pos = find_stat_entry (se, name)))
+          transmit (vb, pos);
+        continue;
+      }
+      for (pos = se->stat_head; NULL != pos; pos = pos->next)
+        transmit (vb, pos);
+    }
+  }
+  flush_batch (vb);
+  GNUNET_free (vb);
+  end.size = htons (sizeof (struct GNUNET_MessageHeader));
+  end.type = htons (GNUNET_MESSAGE_TYPE_STATISTICS_END);
+  GNUNET_SERVER_notification_context_unicast (nc,
+                                              client,
+                                              &end,
+                                              GNUNET_NO);
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
 
@@ -779,16 +1055,6 @@ handle_set (void *cls,
       initial_set = 1;
     }
     pos->persistent = (0 != (flags & GNUNET_STATISTICS_SETFLAG_PERSISTENT));
-    if (pos != se->stat_head)
-    {
-      /* move to front for faster setting next time! */
-      GNUNET_CONTAINER_DLL_remove (se->stat_head,
-                                   se->stat_tail,
-                                   pos);
-      GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                                   se->stat_tail,
-                                   pos);
-    }
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Statistic `%s:%s' updated to value %llu (%d).\n",
                 service,
@@ -822,9 +1088,7 @@ handle_set (void *cls,
   }
   pos->uid = uidgen++;
   pos->persistent = (0 != (flags & GNUNET_STATISTICS_SETFLAG_PERSISTENT));
-  GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                               se->stat_tail,
-                               pos);
+  add_stat_entry (se, pos);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "New statistic on `%s:%s' with value %llu created.\n",
               service,
@@ -898,9 +1162,7 @@ handle_watch (void *cls,
     memcpy (&pos[1], name, nlen);
     pos->name = (const char *) &pos[1];
     pos->subsystem = se;
-    GNUNET_CONTAINER_DLL_insert (se->stat_head,
-                                 se->stat_tail,
-                                 pos);
+    add_stat_entry (se, pos);
     pos->uid = uidgen++;
     pos->set = GNUNET_NO;
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
@@ -917,7 +1179,7 @@ handle_watch (void *cls,
                                pos->we_tail,
                                we);
   if (0 != pos->value)
-    notify_change (pos);
+    notify_watchers (pos);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -934,15 +1196,20 @@ do_shutdown ()
 
   if (NULL == nc)
     return;
+  if (NULL != notify_task)
+  {
+    GNUNET_SCHEDULER_cancel (notify_task);
+    notify_task = NULL;
+  }
+  pending_head = NULL;
+  pending_tail = NULL;
   save ();
   GNUNET_SERVER_notification_context_destroy (nc);
   nc = NULL;
   GNUNET_assert (0 == client_count);
   while (NULL != (se = sub_head))
   {
-    GNUNET_CONTAINER_DLL_remove (sub_head,
-                                 sub_tail,
-                                 se);
+    remove_subsystem_entry (se);
     while (NULL != (pos = se->stat_head))
     {
       GNUNET_CONTAINER_DLL_remove (se->stat_head,
@@ -958,8 +1225,11 @@ do_shutdown ()
       }
       GNUNET_free (pos);
     }
+    GNUNET_CONTAINER_multihashmap_destroy (se->stat_map);
     GNUNET_free (se);
   }
+  GNUNET_CONTAINER_multihashmap_destroy (sub_map);
+  sub_map = NULL;
 }
 
 
@@ -1048,6 +1318,7 @@ run (void *cls,
   };
   cfg = c;
   srv = server;
+  sub_map = GNUNET_CONTAINER_multihashmap_create (32, GNUNET_NO);
   GNUNET_SERVER_add_handlers (server,
                               handlers);
   nc = GNUNET_SERVER_notification_context_create (server, 16);
@@ -40,7 +40,9 @@ GNUNET_NETWORK_STRUCT_BEGIN
 struct GNUNET_STATISTICS_ReplyMessage
 {
   /**
-   * Type:  GNUNET_MESSAGE_TYPE_STATISTICS_VALUE
+   * Type:  GNUNET_MESSAGE_TYPE_STATISTICS_VALUE; the service
+   * transmits these back-to-back in a message of type
+   * #GNUNET_MESSAGE_TYPE_STATISTICS_VALUES.
    */
   struct GNUNET_MessageHeader header;
 
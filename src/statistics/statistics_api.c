@@ -37,8 +37,20 @@
  */
 #define SET_TRANSMIT_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 2)
 
+/**
+ * How long do we collect SET/UPDATE requests before sending them to
+ * the service?  Updates to the same value within this time are
+ * combined into a single message.
+ */
+#define SET_FLUSH_DELAY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 250)
+
 #define LOG(kind,...) GNUNET_log_from (kind, "statistics-api",__VA_ARGS__)
 
+/**
+ * How often do we report the scheduler profile (if enabled)?
+ */
+#define PROFILE_REPORT_FREQUENCY GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 5)
+
 /**
  * Types of actions.
  */
@@ -222,6 +234,17 @@ struct GNUNET_STATISTICS_Handle
    */
   struct GNUNET_STATISTICS_GetHandle *current;
 
+  /**
+   * Queued SET/UPDATE actions, by hash of their name, so that
+   * further changes to the same value can be merged into them.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap *setters;
+
+  /**
+   * Task sending the queued SET/UPDATE actions to the service.
+   */
+  struct GNUNET_SCHEDULER_Task *flush_task;
+
   /**
    * Array of watch entries.
    */
@@ -247,11 +270,21 @@ struct GNUNET_STATISTICS_Handle
    */
   uint64_t peak_rss;
 
+  /**
+   * When did we last report the scheduler profile?
+   */
+  struct GNUNET_TIME_Absolute last_profile_report;
+
   /**
    * Size of the 'watches' array.
    */
   unsigned int watches_size;
 
+  /**
+   * Should we report the scheduler profile of this process?
+   */
+  int profile_scheduler;
+
   /**
    * Should this handle auto-destruct once all actions have
    * been processed?
@@ -311,6 +344,109 @@ update_memory_statistics (struct GNUNET_STATISTICS_Handle *h)
 }
 
 
+/**
+ * Names of the scheduler priorities, for reporting the scheduler profile.
+ */
+static const char *const priority_names[GNUNET_SCHEDULER_PRIORITY_COUNT] = {
+  "keep",
+  "idle",
+  "background",
+  "default",
+  "high",
+  "ui",
+  "urgent",
+  "shutdown"
+};
+
+/**
+ * Names of the buckets of the scheduler profile histograms.
+ */
+static const char *const bucket_names[GNUNET_SCHEDULER_PROFILE_BUCKETS] = {
+  "< 100 us",
+  "< 1 ms",
+  "< 10 ms",
+  "< 100 ms",
+  "< 1 s",
+  ">= 1 s"
+};
+
+
+/**
+ * Report the per-task accounting of the scheduler (if enabled
+ * and if we did not do so recently).
+ *
+ * @param h statistics handle
+ */
+static void
+update_scheduler_statistics (struct GNUNET_STATISTICS_Handle *h)
+{
+  const struct GNUNET_SCHEDULER_Profile *profile;
+  const struct GNUNET_SCHEDULER_TaskProfile *tp;
+  char *name;
+  unsigned int p;
+  unsigned int b;
+  unsigned int i;
+
+  if ( (GNUNET_YES != h->profile_scheduler) ||
+       (GNUNET_NO != h->do_destroy) )
+    return;
+  if (GNUNET_TIME_absolute_get_duration (h->last_profile_report).rel_value_us <
+      PROFILE_REPORT_FREQUENCY.rel_value_us)
+    return;
+  if (NULL == (profile = GNUNET_SCHEDULER_get_profile ()))
+    return;
+  h->last_profile_report = GNUNET_TIME_absolute_get ();
+  /* 'keep' is never used for running tasks */
+  for (p = GNUNET_SCHEDULER_PRIORITY_IDLE; p < GNUNET_SCHEDULER_PRIORITY_COUNT; p++)
+  {
+    for (b = 0; b < GNUNET_SCHEDULER_PROFILE_BUCKETS; b++)
+    {
+      if (0 != profile->latency[p][b])
+      {
+        GNUNET_asprintf (&name,
+                         "# scheduler %s task latency %s",
+                         priority_names[p],
+                         bucket_names[b]);
+        GNUNET_STATISTICS_set (h, name, profile->latency[p][b], GNUNET_NO);
+        GNUNET_free (name);
+      }
+      if (0 != profile->duration[p][b])
+      {
+        GNUNET_asprintf (&name,
+                         "# scheduler %s task run time %s",
+                         priority_names[p],
+                         bucket_names[b]);
+        GNUNET_STATISTICS_set (h, name, profile->duration[p][b], GNUNET_NO);
+        GNUNET_free (name);
+      }
+    }
+    if (0 != profile->max_latency[p].rel_value_us)
+    {
+      GNUNET_asprintf (&name,
+                       "# scheduler %s task max latency (us)",
+                       priority_names[p]);
+      GNUNET_STATISTICS_set (h, name, profile->max_latency[p].rel_value_us, GNUNET_NO);
+      GNUNET_free (name);
+    }
+  }
+  /* slowest last, so that it wins if a callback is listed twice */
+  for (i = profile->slowest_count; i > 0; i--)
+  {
+    tp = &profile->slowest[i - 1];
+    if ('\0' != tp->location[0])
+      GNUNET_asprintf (&name,
+                       "# scheduler slow task %s (us)",
+                       tp->location);
+    else
+      GNUNET_asprintf (&name,
+                       "# scheduler slow task %p (us)",
+                       tp->callback);
+    GNUNET_STATISTICS_set (h, name, tp->duration.rel_value_us, GNUNET_NO);
+    GNUNET_free (name);
+  }
+}
+
+
 /**
  * Schedule the next action to be performed.
  *
@@ -378,6 +514,32 @@ free_action_item (struct GNUNET_STATISTICS_GetHandle *gh)
 }
 
 
+/**
+ * Remove an action from the queue of pending actions.
+ *
+ * @param h statistics handle
+ * @param ai the action to remove
+ */
+static void
+dequeue_action (struct GNUNET_STATISTICS_Handle *h,
+                struct GNUNET_STATISTICS_GetHandle *ai)
+{
+  struct GNUNET_HashCode hc;
+
+  GNUNET_CONTAINER_DLL_remove (h->action_head,
+                               h->action_tail,
+                               ai);
+  if ( (ACTION_SET != ai->type) &&
+       (ACTION_UPDATE != ai->type) )
+    return;
+  GNUNET_CRYPTO_hash (ai->name, strlen (ai->name), &hc);
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (h->setters,
+                                                       &hc,
+                                                       ai));
+}
+
+
 /**
  * Disconnect from the statistics service.
  *
@@ -584,6 +746,50 @@ process_statistics_value_message (struct GNUNET_STATISTICS_Handle *h,
 }
 
 
+/**
+ * Process a #GNUNET_MESSAGE_TYPE_STATISTICS_VALUES message by
+ * processing each of the embedded values.
+ *
+ * @param h statistics handle
+ * @param msg message received from the service, never NULL
+ * @return #GNUNET_OK if the message was well-formed
+ */
+static int
+process_statistics_values_message (struct GNUNET_STATISTICS_Handle *h,
+                                   const struct GNUNET_MessageHeader *msg)
+{
+  const struct GNUNET_MessageHeader *pos;
+  const char *buf;
+  size_t left;
+  uint16_t msize;
+
+  buf = (const char *) &msg[1];
+  left = ntohs (msg->size) - sizeof (struct GNUNET_MessageHeader);
+  while (0 < left)
+  {
+    if (left < sizeof (struct GNUNET_MessageHeader))
+    {
+      GNUNET_break (0);
+      return GNUNET_SYSERR;
+    }
+    pos = (const struct GNUNET_MessageHeader *) buf;
+    msize = ntohs (pos->size);
+    if ( (msize < sizeof (struct GNUNET_MessageHeader)) ||
+         (msize > left) ||
+         (GNUNET_MESSAGE_TYPE_STATISTICS_VALUE != ntohs (pos->type)) )
+    {
+      GNUNET_break (0);
+      return GNUNET_SYSERR;
+    }
+    if (GNUNET_OK != process_statistics_value_message (h, pos))
+      return GNUNET_SYSERR;
+    buf += msize;
+    left -= msize;
+  }
+  return GNUNET_OK;
+}
+
+
 /**
  * We have received a watch value from the service.  Process it.
  *
@@ -719,6 +925,25 @@ receive_stats (void *cls,
 							       current->timeout));
     h->backoff = GNUNET_TIME_UNIT_MILLISECONDS;
     return;
+  case GNUNET_MESSAGE_TYPE_STATISTICS_VALUES:
+    if (NULL == h->current)
+    {
+      GNUNET_break (0);
+      do_disconnect (h);
+      reconnect_later (h);
+      return;
+    }
+    if (GNUNET_OK != process_statistics_values_message (h, msg))
+    {
+      do_disconnect (h);
+      reconnect_later (h);
+      return;
+    }
+    GNUNET_CLIENT_receive (h->client, &receive_stats, h,
+			   GNUNET_TIME_absolute_get_remaining (h->
+							       current->timeout));
+    h->backoff = GNUNET_TIME_UNIT_MILLISECONDS;
+    return;
   case GNUNET_MESSAGE_TYPE_STATISTICS_WATCH_VALUE:
     if (GNUNET_OK !=
 	(ret = process_watch_value (h, msg)))
@@ -902,6 +1127,7 @@ transmit_set (struct GNUNET_STATISTICS_Handle *handle,
   free_action_item (handle->current);
   handle->current = NULL;
   update_memory_statistics (handle);
+  update_scheduler_statistics (handle);
   return nsize;
 }
 
@@ -945,7 +1171,9 @@ transmit_action (void *cls, size_t size, void *buf)
 
 
 /**
- * Get handle for the statistics service.
+ * Get handle for the statistics service.  If the option
+ * "PROFILE_SCHEDULER" is set in the section of @a subsystem, the
+ * scheduler's per-task accounting is enabled and reported as well.
  *
  * @param subsystem name of subsystem using the service
  * @param cfg services configuration in use
@@ -966,6 +1194,14 @@ GNUNET_STATISTICS_create (const char *subsystem,
   ret->cfg = cfg;
   ret->subsystem = GNUNET_strdup (subsystem);
   ret->backoff = GNUNET_TIME_UNIT_MILLISECONDS;
+  ret->setters = GNUNET_CONTAINER_multihashmap_create (32, GNUNET_NO);
+  if (GNUNET_YES ==
+      GNUNET_CONFIGURATION_get_value_yesno (cfg, subsystem, "PROFILE_SCHEDULER"))
+  {
+    ret->profile_scheduler = GNUNET_YES;
+    ret->last_profile_report = GNUNET_TIME_absolute_get ();
+    GNUNET_SCHEDULER_set_profiling (GNUNET_YES);
+  }
   return ret;
 }
 
@@ -1022,11 +1258,14 @@ GNUNET_STATISTICS_destroy (struct GNUNET_STATISTICS_Handle *h,
         free_action_item (pos);
       }
     }
+    if (NULL != h->flush_task)
+    {
+      GNUNET_SCHEDULER_cancel (h->flush_task);
+      h->flush_task = NULL;
+    }
     if ( (NULL == h->current) &&
 	 (NULL != (h->current = h->action_head)) )
-      GNUNET_CONTAINER_DLL_remove (h->action_head,
-				   h->action_tail,
-				   h->current);
+      dequeue_action (h, h->current);
     h->do_destroy = GNUNET_YES;
     if ((NULL != h->current) && (NULL == h->th) &&
 	(NULL != h->client))
@@ -1041,13 +1280,17 @@ GNUNET_STATISTICS_destroy (struct GNUNET_STATISTICS_Handle *h,
     if (NULL != h->th)
       return; /* do not finish destruction just yet */
   }
+  if (NULL != h->flush_task)
+  {
+    GNUNET_SCHEDULER_cancel (h->flush_task);
+    h->flush_task = NULL;
+  }
   while (NULL != (pos = h->action_head))
   {
-    GNUNET_CONTAINER_DLL_remove (h->action_head,
-				 h->action_tail,
-				 pos);
+    dequeue_action (h, pos);
     free_action_item (pos);
   }
+  GNUNET_CONTAINER_multihashmap_destroy (h->setters);
   do_disconnect (h);
   for (i = 0; i < h->watches_size; i++)
   {
@@ -1138,7 +1381,7 @@ schedule_action (struct GNUNET_STATISTICS_Handle *h)
     }
     return;
   }
-  GNUNET_CONTAINER_DLL_remove (h->action_head, h->action_tail, h->current);
+  dequeue_action (h, h->current);
   timeout = GNUNET_TIME_absolute_get_remaining (h->current->timeout);
   if (NULL ==
       (h->th =
@@ -1337,6 +1580,64 @@ GNUNET_STATISTICS_watch_cancel (struct GNUNET_STATISTICS_Handle *handle,
 
 
 
+/**
+ * Send the queued SET/UPDATE requests to the service.
+ *
+ * @param cls the `struct GNUNET_STATISTICS_Handle`
+ * @param tc scheduler context
+ */
+static void
+flush_setters (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_STATISTICS_Handle *h = cls;
+
+  h->flush_task = NULL;
+  schedule_action (h);
+}
+
+
+/**
+ * Closure for #find_setter_it().
+ */
+struct FindSetterContext
+{
+  /**
+   * Name of the value we are looking for.
+   */
+  const char *name;
+
+  /**
+   * Set to the queued action once found.
+   */
+  struct GNUNET_STATISTICS_GetHandle *result;
+};
+
+
+/**
+ * Check if a queued SET/UPDATE action with a matching hash is for
+ * the value we are looking for.
+ *
+ * @param cls the `struct FindSetterContext`
+ * @param key hash of the name
+ * @param value a `struct GNUNET_STATISTICS_GetHandle`
+ * @return #GNUNET_NO if found, #GNUNET_YES to continue
+ */
+static int
+find_setter_it (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  struct FindSetterContext *fsc = cls;
+  struct GNUNET_STATISTICS_GetHandle *ai = value;
+
+  if (0 != strcmp (fsc->name, ai->name))
+    return GNUNET_YES;
+  fsc->result = ai;
+  return GNUNET_NO;
+}
+
+
 /**
  * Queue a request to change a statistic.
  *
@@ -1354,6 +1655,8 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
                    enum ActionType type)
 {
   struct GNUNET_STATISTICS_GetHandle *ai;
+  struct FindSetterContext fsc;
+  struct GNUNET_HashCode hc;
   size_t slen;
   size_t nlen;
   size_t nsize;
@@ -1367,13 +1670,15 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
     GNUNET_break (0);
     return;
   }
-  for (ai = h->action_head; NULL != ai; ai = ai->next)
+  GNUNET_CRYPTO_hash (name, nlen - 1, &hc);
+  fsc.name = name;
+  fsc.result = NULL;
+  GNUNET_CONTAINER_multihashmap_get_multiple (h->setters,
+                                              &hc,
+                                              &find_setter_it,
+                                              &fsc);
+  if (NULL != (ai = fsc.result))
   {
-    if (! ( (0 == strcmp (ai->subsystem, h->subsystem)) &&
-	    (0 == strcmp (ai->name, name)) &&
-	    ( (ACTION_UPDATE == ai->type) ||
-	      (ACTION_SET == ai->type) ) ) )
-      continue;
     if (ACTION_SET == ai->type)
     {
       if (ACTION_UPDATE == type)
@@ -1430,7 +1735,14 @@ add_setter_action (struct GNUNET_STATISTICS_Handle *h,
   ai->type = type;
   GNUNET_CONTAINER_DLL_insert_tail (h->action_head, h->action_tail,
 				    ai);
-  schedule_action (h);
+  GNUNET_CONTAINER_multihashmap_put (h->setters,
+                                     &hc,
+                                     ai,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
+  if (NULL == h->flush_task)
+    h->flush_task = GNUNET_SCHEDULER_add_delayed (SET_FLUSH_DELAY,
+                                                  &flush_setters,
+                                                  h);
 }
 
 
@@ -1484,4 +1796,48 @@ GNUNET_STATISTICS_update (struct GNUNET_STATISTICS_Handle *handle,
 }
 
 
+/**
+ * Record an observation for a histogram of our subsystem.
+ *
+ * @param handle identification of the statistics service
+ * @param name name of the histogram
+ * @param value the observed value
+ * @param make_persistent should the histogram be kept across restarts?
+ */
+void
+GNUNET_STATISTICS_observe (struct GNUNET_STATISTICS_Handle *handle,
+                           const char *name,
+                           uint64_t value,
+                           int make_persistent)
+{
+  char *sname;
+  unsigned int b;
+
+  if (NULL == handle)
+    return;
+  for (b = 0; (b < 64) && (value > (1LLU << b)); b++) ;
+  if (64 == b)
+    GNUNET_asprintf (&sname,
+                     "%s" GNUNET_STATISTICS_HISTOGRAM_BUCKET "+Inf",
+                     name);
+  else
+    GNUNET_asprintf (&sname,
+                     "%s" GNUNET_STATISTICS_HISTOGRAM_BUCKET "%llu",
+                     name,
+                     (unsigned long long) (1LLU << b));
+  GNUNET_STATISTICS_update (handle, sname, 1, make_persistent);
+  GNUNET_free (sname);
+  GNUNET_asprintf (&sname,
+                   "%s" GNUNET_STATISTICS_HISTOGRAM_COUNT,
+                   name);
+  GNUNET_STATISTICS_update (handle, sname, 1, make_persistent);
+  GNUNET_free (sname);
+  GNUNET_asprintf (&sname,
+                   "%s" GNUNET_STATISTICS_HISTOGRAM_SUM,
+                   name);
+  GNUNET_STATISTICS_update (handle, sname, (int64_t) value, make_persistent);
+  GNUNET_free (sname);
+}
+
+
 /* end of statistics_api.c */
@@ -134,6 +134,17 @@ static struct MessageQueue *mq_tail;
  */
 static struct GNUNET_SCHEDULER_Task * shutdown_task_id;
 
+/**
+ * The task for reporting the load of our host to our controller
+ */
+static struct GNUNET_SCHEDULER_Task * load_report_task_id;
+
+/**
+ * How often do we report the load of our host to our controller?
+ */
+#define LOAD_REPORT_FREQUENCY GNUNET_TIME_relative_multiply \
+  (GNUNET_TIME_UNIT_SECONDS, 5)
+
 
 /**
  * Function called to notify a client about the connection begin ready to queue
@@ -474,6 +485,43 @@ parse_shared_services (char *ss_str, struct GNUNET_CONFIGURATION_Handle *cfg)
 }
 
 
+/**
+ * Task to report the load of our host to the controller which started us.  The
+ * controller uses the report to adapt the parallelism of the operations it
+ * runs on our host.
+ *
+ * @param cls NULL
+ * @param tc the TaskContext from scheduler
+ */
+static void
+load_report_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_TESTBED_HostLoadMessage *msg;
+  unsigned int cpu;
+  unsigned int mem;
+  unsigned int fd;
+
+  load_report_task_id = NULL;
+  if (0 != (GNUNET_SCHEDULER_REASON_SHUTDOWN & tc->reason))
+    return;
+  if ( (NULL != GST_context) &&
+       (GNUNET_OK == GST_stats_get_load (&cpu, &mem, &fd)) )
+  {
+    msg = GNUNET_new (struct GNUNET_TESTBED_HostLoadMessage);
+    msg->header.type = htons (GNUNET_MESSAGE_TYPE_TESTBED_HOST_LOAD);
+    msg->header.size = htons (sizeof (struct GNUNET_TESTBED_HostLoadMessage));
+    msg->host_id = htonl (GST_context->host_id);
+    msg->cpu_load = htonl (cpu);
+    msg->mem_usage = htonl (mem);
+    msg->fd_usage = htonl (fd);
+    GST_queue_message (GST_context->client, &msg->header);
+  }
+  load_report_task_id =
+      GNUNET_SCHEDULER_add_delayed (LOAD_REPORT_FREQUENCY,
+                                    &load_report_task, NULL);
+}
+
+
 /**
  * Message handler for GNUNET_MESSAGE_TYPE_TESTBED_INIT messages
  *
@@ -550,6 +598,9 @@ handle_init (void *cls, struct GNUNET_SERVER_Client *client,
                                           GST_config, 0);
   host_list_add (host);
   LOG_DEBUG ("Created master context with host ID: %u\n", GST_context->host_id);
+  load_report_task_id =
+      GNUNET_SCHEDULER_add_delayed (LOAD_REPORT_FREQUENCY,
+                                    &load_report_task, NULL);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -759,6 +810,7 @@ GST_clear_fopcq ()
     case OP_PEER_DESTROY:
     case OP_PEER_INFO:
     case OP_OVERLAY_CONNECT:
+    case OP_BULK_OVERLAY_CONNECT:
     case OP_LINK_CONTROLLERS:
     case OP_GET_SLAVE_CONFIG:
     case OP_MANAGE_SERVICE:
@@ -786,6 +838,11 @@ shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
   shutdown_task_id = NULL;
   LOG_DEBUG ("Shutting down testbed service\n");
+  if (NULL != load_report_task_id)
+  {
+    GNUNET_SCHEDULER_cancel (load_report_task_id);
+    load_report_task_id = NULL;
+  }
   /* cleanup any remaining forwarded operations */
   GST_clear_fopcq ();
   GST_free_lcfq ();
@@ -795,6 +852,7 @@ shutdown_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   GST_free_nccq ();
   GST_neighbour_list_clean();
   GST_free_prcq ();
+  GST_free_pscq ();
   /* Clear peer list */
   GST_destroy_peers ();
   /* Clear route list */
@@ -890,6 +948,8 @@ testbed_run (void *cls, struct GNUNET_SERVER_Handle *server,
     {&GST_handle_overlay_connect, NULL,
      GNUNET_MESSAGE_TYPE_TESTBED_OVERLAY_CONNECT,
      sizeof (struct GNUNET_TESTBED_OverlayConnectMessage)},
+    {&GST_handle_bulk_overlay_connect, NULL,
+     GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT, 0},
     {&GST_handle_remote_overlay_connect, NULL,
      GNUNET_MESSAGE_TYPE_TESTBED_REMOTE_OVERLAY_CONNECT, 0},
     {&GST_handle_manage_peer_service, NULL,
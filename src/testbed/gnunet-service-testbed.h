@@ -557,6 +557,18 @@ GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
                             const struct GNUNET_MessageHeader *message);
 
 
+/**
+ * Handler for GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT messages
+ *
+ * @param cls NULL
+ * @param client identification of the client
+ * @param message the actual message
+ */
+void
+GST_handle_bulk_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *message);
+
+
 /**
  * Adds a host registration's request to a slave's registration queue
  *
@@ -795,6 +807,13 @@ void
 GST_free_prcq ();
 
 
+/**
+ * Frees the peer start queue
+ */
+void
+GST_free_pscq ();
+
+
 /**
  * Initializes the cache
  *
@@ -834,7 +853,8 @@ GST_cache_add_hello (const unsigned int peer_id,
 
 
 /**
- * Initialize logging CPU and IO statisticfs.  Checks the configuration for
+ * Initialize sampling CPU and IO statistics.  The samples are used for
+ * reporting our load to our controller.  Also checks the configuration for
  * "STATS_DIR" and logs to a file in that directory.  The file is name is
  * generated from the hostname and the process's PID.
  */
@@ -842,6 +862,19 @@ void
 GST_stats_init (const struct GNUNET_CONFIGURATION_Handle *cfg);
 
 
+/**
+ * Get the load of this host as seen at the last sample.
+ *
+ * @param cpu set to the CPU load in percent
+ * @param mem set to the memory usage in percent
+ * @param fd set to the file descriptor usage in percent
+ * @return #GNUNET_OK upon success; #GNUNET_SYSERR if the load is not known
+ *           (yet)
+ */
+int
+GST_stats_get_load (unsigned int *cpu, unsigned int *mem, unsigned int *fd);
+
+
 /**
  * Shutdown the status calls module.
  */
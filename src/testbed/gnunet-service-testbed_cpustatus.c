@@ -87,6 +87,21 @@ struct GNUNET_BIO_WriteHandle *bw;
 
 struct GNUNET_SCHEDULER_Task * sample_load_task_id;
 
+/**
+ * The CPU load seen at the last sample; -1 if not yet known
+ */
+static int last_cpu_load = -1;
+
+/**
+ * The memory usage seen at the last sample
+ */
+static unsigned int last_mem_usage;
+
+/**
+ * The file descriptor usage seen at the last sample
+ */
+static unsigned int last_fd_usage;
+
 
 #ifdef OSX
 static int
@@ -642,6 +657,39 @@ get_nproc ()
   closedir (dir);
   return nproc;
 }
+
+
+/**
+ * Get the percentage of file descriptors used by this process with respect
+ * to its limit on open files.  Peers started by us inherit the same limit
+ * and the sockets of our client connections to them count against ours.
+ *
+ * @return the percentage of file descriptors used; 0 if unknown
+ */
+static unsigned int
+fd_get_usage ()
+{
+  struct rlimit rl;
+  DIR *dir;
+  struct dirent *ent;
+  unsigned long long nfds;
+
+  if ( (0 != getrlimit (RLIMIT_NOFILE, &rl)) ||
+       (RLIM_INFINITY == rl.rlim_cur) ||
+       (0 == rl.rlim_cur) )
+    return 0;
+  dir = opendir ("/proc/self/fd");
+  if (NULL == dir)
+    return 0;
+  nfds = 0;
+  while (NULL != (ent = readdir (dir)))
+  {
+    if ('.' != *ent->d_name)
+      nfds++;
+  }
+  closedir (dir);
+  return (unsigned int) GNUNET_MIN (100, nfds * 100 / rl.rlim_cur);
+}
 #endif
 
 
@@ -664,6 +712,13 @@ sample_load_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   if ( (-1 == ld_cpu) || (-1 == ld_disk) )
     goto reschedule;
   mem_usage = mem_get_usage ();
+  last_cpu_load = ld_cpu;
+  last_mem_usage = mem_usage;
+#ifdef LINUX
+  last_fd_usage = fd_get_usage ();
+#endif
+  if (NULL == bw)
+    goto reschedule;
 #ifdef LINUX
   nproc = get_nproc ();
 #else
@@ -688,7 +743,29 @@ sample_load_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
 
 /**
- * Initialize logging CPU and IO statisticfs.  Checks the configuration for
+ * Get the load of this host as seen at the last sample.
+ *
+ * @param cpu set to the CPU load in percent
+ * @param mem set to the memory usage in percent
+ * @param fd set to the file descriptor usage in percent
+ * @return #GNUNET_OK upon success; #GNUNET_SYSERR if the load is not known
+ *           (yet)
+ */
+int
+GST_stats_get_load (unsigned int *cpu, unsigned int *mem, unsigned int *fd)
+{
+  if (-1 == last_cpu_load)
+    return GNUNET_SYSERR;
+  *cpu = (unsigned int) GNUNET_MIN (100, last_cpu_load);
+  *mem = GNUNET_MIN (100, last_mem_usage);
+  *fd = last_fd_usage;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Initialize sampling CPU and IO statistics.  The samples are used for
+ * reporting our load to our controller.  Also checks the configuration for
  * "STATS_DIR" and logs to a file in that directory.  The file is name is
  * generated from the hostname and the process's PID.
  */
@@ -706,34 +783,31 @@ GST_stats_init (const struct GNUNET_CONFIGURATION_Handle *cfg)
   return;                       /* No logging on windows for now :( */
 #endif
 
-  if (GNUNET_OK !=
+  sample_load_task_id = GNUNET_SCHEDULER_add_now (&sample_load_task, NULL);
+  if (GNUNET_OK ==
       GNUNET_CONFIGURATION_get_value_filename (cfg, "testbed",
                                                "STATS_DIR", &stats_dir))
-    return;
-  len = GNUNET_OS_get_hostname_max_length ();
-  hostname = GNUNET_malloc (len);
-  if (0 != gethostname  (hostname, len))
   {
-    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "gethostname");
+    len = GNUNET_OS_get_hostname_max_length ();
+    hostname = GNUNET_malloc (len);
+    if (0 != gethostname  (hostname, len))
+    {
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING, "gethostname");
+    }
+    else
+    {
+      fn = NULL;
+      (void) GNUNET_asprintf (&fn, "%s/%.*s-%jd.dat", stats_dir, len,
+                              hostname, (intmax_t) getpid());
+      if (NULL == (bw = GNUNET_BIO_write_open (fn)))
+        GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                    _("Cannot open %s for writing load statistics.  "
+                      "Not logging load statistics\n"), fn);
+      GNUNET_free (fn);
+    }
     GNUNET_free (stats_dir);
     GNUNET_free (hostname);
-    return;
-  }
-  fn = NULL;
-  (void) GNUNET_asprintf (&fn, "%s/%.*s-%jd.dat", stats_dir, len,
-                          hostname, (intmax_t) getpid());
-  GNUNET_free (stats_dir);
-  GNUNET_free (hostname);
-  if (NULL == (bw = GNUNET_BIO_write_open (fn)))
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                _("Cannot open %s for writing load statistics.  "
-                  "Not logging load statistics\n"), fn);
-    GNUNET_free (fn);
-    return;
   }
-  GNUNET_free (fn);
-  sample_load_task_id = GNUNET_SCHEDULER_add_now (&sample_load_task, NULL);
 #ifdef LINUX
   proc_stat = fopen ("/proc/stat", "r");
   if (NULL == proc_stat)
@@ -756,8 +830,6 @@ GST_stats_destroy ()
 #if MINGW
   return;
 #endif
-  if (NULL == bw)
-    return;
 #ifdef LINUX
   if (proc_stat != NULL)
     {
@@ -772,8 +844,12 @@ GST_stats_destroy ()
     GNUNET_SCHEDULER_cancel (sample_load_task_id);
     sample_load_task_id = NULL;
   }
-  GNUNET_break (GNUNET_OK == GNUNET_BIO_write_close (bw));
-  bw = NULL;
+  if (NULL != bw)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_BIO_write_close (bw));
+    bw = NULL;
+  }
+  last_cpu_load = -1;
 }
 
 /* end of cpustatus.c */
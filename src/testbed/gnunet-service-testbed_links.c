@@ -735,6 +735,26 @@ lcf_proc_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 }
 
 
+/**
+ * Relays the host load reports received from a slave controller to our
+ * controller so that it can adapt the operations it runs on the slave's host
+ *
+ * @param cls the slave
+ * @param msg the host load report
+ */
+static void
+slave_load_relay (void *cls, const struct GNUNET_TESTBED_HostLoadMessage *msg)
+{
+  struct GNUNET_TESTBED_HostLoadMessage *dup_msg;
+
+  if ( (NULL == GST_context) || (NULL == GST_context->client) )
+    return;
+  dup_msg = GNUNET_new (struct GNUNET_TESTBED_HostLoadMessage);
+  memcpy (dup_msg, msg, sizeof (struct GNUNET_TESTBED_HostLoadMessage));
+  GST_queue_message (GST_context->client, &dup_msg->header);
+}
+
+
 /**
  * Callback for event from slave controllers
  *
@@ -808,6 +828,8 @@ slave_status_cb (void *cls, const struct GNUNET_CONFIGURATION_Handle *cfg,
                                          slave);
   if (NULL != slave->controller)
   {
+    GNUNET_TESTBED_controller_set_load_relay_ (slave->controller,
+                                               &slave_load_relay, slave);
     send_controller_link_response (lcc->client, lcc->operation_id, cfg, NULL);
   }
   else
@@ -36,6 +36,17 @@
 #define LOG(kind,...)                                   \
   GNUNET_log_from (kind, "testbed-OC", __VA_ARGS__)
 
+/**
+ * How often do we report the progress of a bulk overlay connect operation?
+ */
+#define BULK_PROGRESS_FREQUENCY GNUNET_TIME_UNIT_SECONDS
+
+
+/**
+ * Context information for bulk overlay connect operations
+ */
+struct BulkOverlayConnectContext;
+
 
 /**
  * Context information for requesting TRANSPORT to connect to a peer
@@ -262,6 +273,12 @@ struct OverlayConnectContext
    */
   struct GNUNET_SCHEDULER_Task * cleanup_task;
 
+  /**
+   * The bulk overlay connect operation this context is a part of; NULL if it
+   * was created for a single overlay connect request
+   */
+  struct BulkOverlayConnectContext *bocc;
+
   /**
    * The type of this context information
    */
@@ -274,6 +291,91 @@ struct OverlayConnectContext
 };
 
 
+/**
+ * Context information for bulk overlay connect operations.  The HELLO of the
+ * first peer is acquired once and then an overlay connect context is created
+ * for each of the other peers.  Instead of a message for each connection, the
+ * progress is reported to the client in aggregate.
+ */
+struct BulkOverlayConnectContext
+{
+  /**
+   * The next pointer for maintaining a DLL of all BulkOverlayConnectContexts
+   */
+  struct BulkOverlayConnectContext *next;
+
+  /**
+   * The prev pointer for maintaining a DLL of all BulkOverlayConnectContexts
+   */
+  struct BulkOverlayConnectContext *prev;
+
+  /**
+   * The client which has requested the operation
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * The first peer; the other peers connect to it
+   */
+  struct Peer *peer;
+
+  /**
+   * The other peers
+   */
+  struct GNUNET_TESTBED_BulkOverlayConnectTarget *targets;
+
+  /**
+   * The #GST_ConnectionPool_GetHandle for the first peer's transport handle
+   */
+  struct GST_ConnectionPool_GetHandle *cgh_p1th;
+
+  /**
+   * Handle to acquire the HELLO of the first peer
+   */
+  struct GNUNET_TRANSPORT_GetHelloHandle *ghh;
+
+  /**
+   * Task to timeout acquiring the HELLO of the first peer
+   */
+  struct GNUNET_SCHEDULER_Task *timeout_task;
+
+  /**
+   * Task to report the progress of the operation
+   */
+  struct GNUNET_SCHEDULER_Task *progress_task;
+
+  /**
+   * The error message we send if acquiring the HELLO of the first peer fails
+   */
+  char *emsg;
+
+  /**
+   * The id of the operation
+   */
+  uint64_t op_id;
+
+  /**
+   * The number of other peers
+   */
+  unsigned int ntotal;
+
+  /**
+   * The number of overlay connections established
+   */
+  unsigned int ncompleted;
+
+  /**
+   * The number of overlay connections which failed
+   */
+  unsigned int nfailed;
+
+  /**
+   * Are we still creating the overlay connect contexts?
+   */
+  int starting;
+};
+
+
 /**
  * Context information for remote overlay connect operations.  Remote overlay
  * connections are used when peers A and B reside on different hosts.  In these
@@ -356,6 +458,17 @@ static struct RemoteOverlayConnectCtx *roccq_head;
  */
 static struct RemoteOverlayConnectCtx *roccq_tail;
 
+/**
+ * DLL head for BulkOverlayConnectContext DLL - to be used to clean up during
+ * shutdown
+ */
+static struct BulkOverlayConnectContext *boccq_head;
+
+/**
+ * DLL tail for BulkOverlayConnectContext DLL
+ */
+static struct BulkOverlayConnectContext *boccq_tail;
+
 
 /**
  * Cleans up ForwardedOverlayConnectContext
@@ -424,6 +537,61 @@ forwarded_overlay_connect_listener (void *cls,
 }
 
 
+/**
+ * Callback to be called when a forwarded bulk overlay connect operation reports
+ * its progress.  Intermediate progress is relayed to the client and the
+ * operation is given more time; the final progress or a failure is handled
+ * like the reply to a forwarded overlay connect
+ *
+ * @param cls ForwardedOperationContext
+ * @param msg the progress message or the operation failure message
+ */
+static void
+forwarded_bulk_overlay_connect_listener (void *cls,
+                                         const struct GNUNET_MessageHeader *msg)
+{
+  struct ForwardedOperationContext *fopc = cls;
+  const struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage *pmsg;
+
+  if (GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS ==
+      ntohs (msg->type))
+  {
+    pmsg = (const struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage *)
+        msg;
+    if (ntohl (pmsg->ncompleted) + ntohl (pmsg->nfailed) < ntohl (pmsg->ntotal))
+    {
+      GST_queue_message (fopc->client, GNUNET_copy_message (msg));
+      GNUNET_SCHEDULER_cancel (fopc->timeout_task);
+      fopc->timeout_task =
+          GNUNET_SCHEDULER_add_delayed (GST_timeout,
+                                        (NULL == fopc->cls) ?
+                                        &GST_forwarded_operation_timeout :
+                                        &forwarded_overlay_connect_timeout,
+                                        fopc);
+      return;
+    }
+  }
+  if (NULL == fopc->cls)
+    GST_forwarded_operation_reply_relay (cls, msg);
+  else
+    forwarded_overlay_connect_listener (cls, msg);
+}
+
+
+/**
+ * Registers the hosts of the peers in a bulk overlay connect request at the
+ * slave controller of the first peer, if needed
+ *
+ * @param peer the first peer; must be a remote peer
+ * @param msg the bulk overlay connect request
+ * @return a registration context of a host whose registration is pending;
+ *           NULL if all hosts are registered at the slave
+ */
+static struct RegisteredHostContext *
+bulk_register_hosts (struct Peer *peer,
+                     const struct GNUNET_TESTBED_BulkOverlayConnectMessage *msg);
+
+
 /**
  * Processes a forwarded overlay connect context in the queue of the given RegisteredHostContext
  *
@@ -434,25 +602,45 @@ GST_process_next_focc (struct RegisteredHostContext *rhc)
 {
   struct ForwardedOperationContext *fopc;
   struct ForwardedOverlayConnectContext *focc;
+  struct RegisteredHostContext *pending_rhc;
   struct Peer *peer;
   struct Slave *slave;
+  int bulk;
 
-  focc = rhc->focc_dll_head;
-  GNUNET_assert (NULL != focc);
-  GNUNET_assert (RHC_DONE == rhc->state);
-  GNUNET_assert (VALID_PEER_ID (focc->peer1));
-  peer = GST_peer_list[focc->peer1];
-  GNUNET_assert (GNUNET_YES == peer->is_remote);
-  GNUNET_assert (NULL != (slave = peer->details.remote.slave));
+  while (1)
+  {
+    focc = rhc->focc_dll_head;
+    GNUNET_assert (NULL != focc);
+    GNUNET_assert (RHC_DONE == rhc->state);
+    GNUNET_assert (VALID_PEER_ID (focc->peer1));
+    peer = GST_peer_list[focc->peer1];
+    GNUNET_assert (GNUNET_YES == peer->is_remote);
+    GNUNET_assert (NULL != (slave = peer->details.remote.slave));
+    bulk = (GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT ==
+            ntohs (focc->orig_msg->type));
+    if ((!bulk) ||
+        (NULL == (pending_rhc = bulk_register_hosts
+                  (peer, (const struct GNUNET_TESTBED_BulkOverlayConnectMessage *)
+                   focc->orig_msg))))
+      break;
+    /* a bulk request waits until all its hosts are registered */
+    GNUNET_CONTAINER_DLL_remove (rhc->focc_dll_head, rhc->focc_dll_tail, focc);
+    GNUNET_CONTAINER_DLL_insert_tail (pending_rhc->focc_dll_head,
+                                      pending_rhc->focc_dll_tail, focc);
+    if (NULL == rhc->focc_dll_head)
+      return;
+  }
   fopc = GNUNET_new (struct ForwardedOperationContext);
   GNUNET_SERVER_client_keep (focc->client);
   fopc->client = focc->client;
   fopc->operation_id = focc->operation_id;
   fopc->cls = rhc;
-  fopc->type = OP_OVERLAY_CONNECT;
+  fopc->type = bulk ? OP_BULK_OVERLAY_CONNECT : OP_OVERLAY_CONNECT;
   fopc->opc =
       GNUNET_TESTBED_forward_operation_msg_ (slave->controller,
                                              focc->operation_id, focc->orig_msg,
+                                             bulk ?
+                                             &forwarded_bulk_overlay_connect_listener :
                                              &forwarded_overlay_connect_listener,
                                              fopc);
   GNUNET_free (focc->orig_msg);
@@ -576,6 +764,119 @@ do_cleanup_occ (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 }
 
 
+/**
+ * Cleanup bulk overlay connect context structure
+ *
+ * @param bocc the bulk overlay connect context
+ */
+static void
+cleanup_bocc (struct BulkOverlayConnectContext *bocc)
+{
+  LOG_DEBUG ("0x%llx: Cleaning up bocc\n", bocc->op_id);
+  if (NULL != bocc->timeout_task)
+    GNUNET_SCHEDULER_cancel (bocc->timeout_task);
+  if (NULL != bocc->progress_task)
+    GNUNET_SCHEDULER_cancel (bocc->progress_task);
+  if (NULL != bocc->ghh)
+    GNUNET_TRANSPORT_get_hello_cancel (bocc->ghh);
+  if (NULL != bocc->cgh_p1th)
+    GST_connection_pool_get_handle_done (bocc->cgh_p1th);
+  GNUNET_assert (bocc->peer->reference_cnt > 0);
+  bocc->peer->reference_cnt--;
+  if (PEER_EXPIRED (bocc->peer))
+    GST_destroy_peer (bocc->peer);
+  GNUNET_free_non_null (bocc->emsg);
+  GNUNET_SERVER_client_drop (bocc->client);
+  GNUNET_free (bocc->targets);
+  GNUNET_CONTAINER_DLL_remove (boccq_head, boccq_tail, bocc);
+  GNUNET_free (bocc);
+}
+
+
+/**
+ * Sends the progress of a bulk overlay connect operation to its client
+ *
+ * @param bocc the bulk overlay connect context
+ */
+static void
+send_bulk_progress_msg (struct BulkOverlayConnectContext *bocc)
+{
+  struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage *msg;
+
+  LOG_DEBUG ("0x%llx: %u of %u peers connected, %u failed\n", bocc->op_id,
+             bocc->ncompleted, bocc->ntotal, bocc->nfailed);
+  msg = GNUNET_new (struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage);
+  msg->header.size =
+      htons (sizeof (struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage));
+  msg->header.type =
+      htons (GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS);
+  msg->ncompleted = htonl (bocc->ncompleted);
+  msg->nfailed = htonl (bocc->nfailed);
+  msg->ntotal = htonl (bocc->ntotal);
+  msg->operation_id = GNUNET_htonll (bocc->op_id);
+  GST_queue_message (bocc->client, &msg->header);
+}
+
+
+/**
+ * Task to report the progress of a bulk overlay connect operation
+ *
+ * @param cls the bulk overlay connect context
+ * @param tc the task context
+ */
+static void
+bocc_progress_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct BulkOverlayConnectContext *bocc = cls;
+
+  bocc->progress_task = NULL;
+  send_bulk_progress_msg (bocc);
+}
+
+
+/**
+ * Checks whether a bulk overlay connect operation is finished.  If so, the
+ * final progress is sent to the client and the context is cleaned up.
+ * Otherwise a progress report is scheduled unless one is pending already.
+ *
+ * @param bocc the bulk overlay connect context
+ */
+static void
+bocc_check_done (struct BulkOverlayConnectContext *bocc)
+{
+  if (GNUNET_YES == bocc->starting)
+    return;
+  if (bocc->ncompleted + bocc->nfailed < bocc->ntotal)
+  {
+    if (NULL == bocc->progress_task)
+      bocc->progress_task =
+          GNUNET_SCHEDULER_add_delayed (BULK_PROGRESS_FREQUENCY,
+                                        &bocc_progress_task, bocc);
+    return;
+  }
+  send_bulk_progress_msg (bocc);
+  cleanup_bocc (bocc);
+}
+
+
+/**
+ * Accounts the result of an overlay connection which is a part of a bulk
+ * overlay connect operation
+ *
+ * @param bocc the bulk overlay connect context
+ * @param success GNUNET_YES if the connection is established; GNUNET_NO if not
+ */
+static void
+bocc_occ_done (struct BulkOverlayConnectContext *bocc, int success)
+{
+  if (GNUNET_YES == success)
+    bocc->ncompleted++;
+  else
+    bocc->nfailed++;
+  bocc_check_done (bocc);
+}
+
+
 /**
  * Task which will be run when overlay connect request has been timed out
  *
@@ -593,7 +894,14 @@ timeout_overlay_connect (void *cls,
   /* LOG (GNUNET_ERROR_TYPE_WARNING, */
   /*      "0x%llx: Timeout while connecting peers %u and %u: %s\n", occ->op_id, */
   /*      occ->peer->id, occ->other_peer_id, occ->emsg); */
-  GST_send_operation_fail_msg (occ->client, occ->op_id, occ->emsg);
+  if (NULL != occ->bocc)
+  {
+    LOG_DEBUG ("%s\n", occ->emsg);
+    bocc_occ_done (occ->bocc, GNUNET_NO);
+    occ->bocc = NULL;
+  }
+  else
+    GST_send_operation_fail_msg (occ->client, occ->op_id, occ->emsg);
   cleanup_occ (occ);
 }
 
@@ -603,6 +911,12 @@ send_overlay_connect_success_msg (struct OverlayConnectContext *occ)
 {
   struct GNUNET_TESTBED_ConnectionEventMessage *msg;
 
+  if (NULL != occ->bocc)
+  {
+    bocc_occ_done (occ->bocc, GNUNET_YES);
+    occ->bocc = NULL;
+    return;
+  }
   LOG_DEBUG ("0x%llx: Peers connected - Sending overlay connect success\n",
              occ->op_id);
   msg = GNUNET_new (struct GNUNET_TESTBED_ConnectionEventMessage);
@@ -1152,7 +1466,10 @@ host_registration_comp (void *cls, const char *emsg)
   struct RegisteredHostContext *rhc = cls;
 
   rhc->state = RHC_DONE;
-  GST_process_next_focc (rhc);
+  /* hosts needed by bulk overlay connects are registered without waiting
+     requests */
+  if (NULL != rhc->focc_dll_head)
+    GST_process_next_focc (rhc);
 }
 
 
@@ -1355,6 +1672,11 @@ p2_controller_connect_cb (void *cls, struct GNUNET_TESTBED_Controller *c)
   rp2c = &occ->p2ctx.remote;
   rp2c->ncn = NULL;
   rp2c->p2c = c;
+  /* the connections of a bulk operation share its id; use our own id for
+     the suboperations at the other controller so that they can be told
+     apart */
+  if (NULL != occ->bocc)
+    occ->op_id = GNUNET_TESTBED_get_next_op_id (c);
   cmsg.header.size =
       htons (sizeof (struct GNUNET_TESTBED_PeerGetConfigurationMessage));
   cmsg.header.type =
@@ -1374,60 +1696,28 @@ p2_controller_connect_cb (void *cls, struct GNUNET_TESTBED_Controller *c)
 
 
 /**
- * Handler for GNUNET_MESSAGE_TYPE_TESTBED_OLCONNECT messages
+ * Creates an overlay connect context to connect the given local peer 1 with
+ * peer 2 and starts connecting them
  *
- * @param cls NULL
- * @param client identification of the client
- * @param message the actual message
+ * @param client the client which requested the overlay connection
+ * @param operation_id the id of the operation
+ * @param p1 the id of peer 1; must be a valid local peer
+ * @param p2 the id of peer 2
+ * @param peer2_host_id the id of the host where peer 2 is running
+ * @param bocc the bulk overlay connect operation the connection is a part of;
+ *          NULL if it is requested on its own
+ * @return GNUNET_OK if the context is created; GNUNET_SYSERR if peer 2 cannot
+ *           be found
  */
-void
-GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
-                            const struct GNUNET_MessageHeader *message)
+static int
+occ_create (struct GNUNET_SERVER_Client *client, uint64_t operation_id,
+            uint32_t p1, uint32_t p2, uint32_t peer2_host_id,
+            struct BulkOverlayConnectContext *bocc)
 {
-  const struct GNUNET_TESTBED_OverlayConnectMessage *msg;
-  struct Peer *peer;
   struct Peer *peer2;
   struct OverlayConnectContext *occ;
   struct Neighbour *p2n;
-  uint64_t operation_id;
-  uint32_t p1;
-  uint32_t p2;
-  uint32_t peer2_host_id;
 
-  if (sizeof (struct GNUNET_TESTBED_OverlayConnectMessage) !=
-      ntohs (message->size))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
-    return;
-  }
-  msg = (const struct GNUNET_TESTBED_OverlayConnectMessage *) message;
-  p1 = ntohl (msg->peer1);
-  p2 = ntohl (msg->peer2);
-  if (!VALID_PEER_ID (p1))
-  {
-    GNUNET_break (0);
-    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
-    return;
-  }
-  peer = GST_peer_list[p1];
-  operation_id = GNUNET_ntohll (msg->operation_id);
-  LOG_DEBUG
-      ("Received overlay connect for peers %u and %u with op id: 0x%llx\n", p1,
-       p2, operation_id);
-  peer2_host_id = ntohl (msg->peer2_host_id);
-  if (GNUNET_YES == peer->is_remote)
-  {
-    if (!VALID_HOST_ID (peer2_host_id))
-    {
-      GNUNET_break (0);
-      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
-      return;
-    }
-    forward_overlay_connect (msg, client);
-    GNUNET_SERVER_receive_done (client, GNUNET_OK);
-    return;
-  }
   p2n = NULL;
   occ = GNUNET_new (struct OverlayConnectContext);
   occ->type = OCC_TYPE_LOCAL;
@@ -1441,9 +1731,8 @@ GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
         LOG (GNUNET_ERROR_TYPE_WARNING,
              "0x%llx: Peer %u's host not in our neighbours list\n",
              operation_id, p2);
-        GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
         GNUNET_free (occ);
-        return;
+        return GNUNET_SYSERR;
       }
       p2n = GST_create_neighbour (GST_host_list[peer2_host_id]);
     }
@@ -1458,6 +1747,7 @@ GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
   GNUNET_CONTAINER_DLL_insert_tail (occq_head, occq_tail, occ);
   GNUNET_SERVER_client_keep (client);
   occ->client = client;
+  occ->bocc = bocc;
   occ->other_peer_id = p2;
   GST_peer_list[p1]->reference_cnt++;
   occ->peer = GST_peer_list[p1];
@@ -1494,7 +1784,377 @@ GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
                                         &overlay_connect_notify, occ);
     break;
   }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Handler for GNUNET_MESSAGE_TYPE_TESTBED_OLCONNECT messages
+ *
+ * @param cls NULL
+ * @param client identification of the client
+ * @param message the actual message
+ */
+void
+GST_handle_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
+                            const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_TESTBED_OverlayConnectMessage *msg;
+  struct Peer *peer;
+  uint64_t operation_id;
+  uint32_t p1;
+  uint32_t p2;
+  uint32_t peer2_host_id;
+
+  if (sizeof (struct GNUNET_TESTBED_OverlayConnectMessage) !=
+      ntohs (message->size))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  msg = (const struct GNUNET_TESTBED_OverlayConnectMessage *) message;
+  p1 = ntohl (msg->peer1);
+  p2 = ntohl (msg->peer2);
+  if (!VALID_PEER_ID (p1))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  peer = GST_peer_list[p1];
+  operation_id = GNUNET_ntohll (msg->operation_id);
+  LOG_DEBUG
+      ("Received overlay connect for peers %u and %u with op id: 0x%llx\n", p1,
+       p2, operation_id);
+  peer2_host_id = ntohl (msg->peer2_host_id);
+  if (GNUNET_YES == peer->is_remote)
+  {
+    if (!VALID_HOST_ID (peer2_host_id))
+    {
+      GNUNET_break (0);
+      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+      return;
+    }
+    forward_overlay_connect (msg, client);
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
+  if (GNUNET_OK != occ_create (client, operation_id, p1, p2, peer2_host_id,
+                               NULL))
+  {
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
+/**
+ * Registers the hosts of the peers in a bulk overlay connect request at the
+ * slave controller of the first peer, if needed
+ *
+ * @param peer the first peer; must be a remote peer
+ * @param msg the bulk overlay connect request
+ * @return a registration context of a host whose registration is pending;
+ *           NULL if all hosts are registered at the slave
+ */
+static struct RegisteredHostContext *
+bulk_register_hosts (struct Peer *peer,
+                     const struct GNUNET_TESTBED_BulkOverlayConnectMessage *msg)
+{
+  const struct GNUNET_TESTBED_BulkOverlayConnectTarget *targets;
+  struct RegisteredHostContext *rhc;
+  struct RegisteredHostContext *pending;
+  struct Route *route_to_peer1_host;
+  struct Route *route_to_peer2_host;
+  uint32_t npeers;
+  uint32_t cnt;
+  uint32_t peer2_host_id;
+
+  GNUNET_assert (GNUNET_YES == peer->is_remote);
+  route_to_peer1_host = GST_find_dest_route
+      (peer->details.remote.remote_host_id);
+  GNUNET_assert (NULL != route_to_peer1_host);
+  targets = (const struct GNUNET_TESTBED_BulkOverlayConnectTarget *) &msg[1];
+  npeers = ntohl (msg->npeers);
+  pending = NULL;
+  for (cnt = 0; cnt < npeers; cnt++)
+  {
+    peer2_host_id = ntohl (targets[cnt].peer2_host_id);
+    route_to_peer2_host = GST_find_dest_route (peer2_host_id);
+    if ((NULL != route_to_peer2_host) &&
+        (route_to_peer1_host->dest == route_to_peer2_host->dest))
+      continue;
+    rhc = register_host (peer->details.remote.slave,
+                         GST_host_list[peer2_host_id]);
+    if ((NULL != rhc) && (NULL == pending))
+      pending = rhc;
+  }
+  return pending;
+}
+
+
+/**
+ * Forwards the bulk overlay connect request to the slave controller of the
+ * first peer once the hosts of all the other peers are registered there
+ *
+ * @param msg the bulk overlay connect request message to be forwarded
+ * @param client the client to which the progress of the forwarded request has
+ *          to be notified
+ */
+static void
+forward_bulk_overlay_connect (const struct
+                              GNUNET_TESTBED_BulkOverlayConnectMessage *msg,
+                              struct GNUNET_SERVER_Client *client)
+{
+  struct ForwardedOperationContext *fopc;
+  struct ForwardedOverlayConnectContext *focc;
+  struct RegisteredHostContext *rhc;
+  struct Peer *peer;
+  uint64_t op_id;
+  uint32_t p1;
+
+  p1 = ntohl (msg->peer1);
+  op_id = GNUNET_ntohll (msg->operation_id);
+  peer = GST_peer_list[p1];
+  LOG_DEBUG ("0x%llx: Forwarding bulk overlay connect\n", op_id);
+  if (NULL != (rhc = bulk_register_hosts (peer, msg)))
+  {
+    focc = GNUNET_new (struct ForwardedOverlayConnectContext);
+    focc->peer1 = p1;
+    focc->peer2 = UINT32_MAX;
+    focc->peer2_host_id = UINT32_MAX;
+    focc->orig_msg = GNUNET_copy_message (&msg->header);
+    focc->operation_id = op_id;
+    focc->client = client;
+    GNUNET_SERVER_client_keep (client);
+    GNUNET_CONTAINER_DLL_insert_tail (rhc->focc_dll_head, rhc->focc_dll_tail,
+                                      focc);
+    return;
+  }
+  fopc = GNUNET_new (struct ForwardedOperationContext);
+  GNUNET_SERVER_client_keep (client);
+  fopc->client = client;
+  fopc->operation_id = op_id;
+  fopc->type = OP_BULK_OVERLAY_CONNECT;
+  fopc->opc =
+      GNUNET_TESTBED_forward_operation_msg_ (peer->details.remote.
+                                             slave->controller, op_id,
+                                             &msg->header,
+                                             &forwarded_bulk_overlay_connect_listener,
+                                             fopc);
+  fopc->timeout_task =
+      GNUNET_SCHEDULER_add_delayed (GST_timeout, &GST_forwarded_operation_timeout,
+                                    fopc);
+  GNUNET_CONTAINER_DLL_insert_tail (fopcq_head, fopcq_tail, fopc);
+}
+
+
+/**
+ * Creates the overlay connect contexts of a bulk overlay connect operation
+ * after the HELLO of the first peer is in the HELLO cache
+ *
+ * @param bocc the bulk overlay connect context
+ */
+static void
+bocc_start_occs (struct BulkOverlayConnectContext *bocc)
+{
+  unsigned int cnt;
+
+  bocc->starting = GNUNET_YES;
+  for (cnt = 0; cnt < bocc->ntotal; cnt++)
+  {
+    if (GNUNET_OK !=
+        occ_create (bocc->client, bocc->op_id, bocc->peer->id,
+                    ntohl (bocc->targets[cnt].peer2),
+                    ntohl (bocc->targets[cnt].peer2_host_id), bocc))
+      bocc->nfailed++;
+  }
+  bocc->starting = GNUNET_NO;
+  bocc_check_done (bocc);
+}
+
+
+/**
+ * Task which will be run when acquiring the HELLO of the first peer of a bulk
+ * overlay connect operation has timed out or failed
+ *
+ * @param cls the bulk overlay connect context
+ * @param tc the task context
+ */
+static void
+bocc_timeout (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct BulkOverlayConnectContext *bocc = cls;
+
+  bocc->timeout_task = NULL;
+  GST_send_operation_fail_msg (bocc->client, bocc->op_id, bocc->emsg);
+  cleanup_bocc (bocc);
+}
+
+
+/**
+ * Function called whenever there is an update to the HELLO of the first peer of
+ * a bulk overlay connect operation.  A valid HELLO is put into the HELLO cache
+ * and the overlay connections are started.
+ *
+ * @param cls the bulk overlay connect context
+ * @param hello the updated HELLO
+ */
+static void
+bocc_hello_cb (void *cls, const struct GNUNET_MessageHeader *hello)
+{
+  struct BulkOverlayConnectContext *bocc = cls;
+  int empty;
+
+  empty = GNUNET_YES;
+  (void) GNUNET_HELLO_iterate_addresses ((const struct GNUNET_HELLO_Message *)
+                                         hello, GNUNET_NO, &test_address,
+                                         &empty);
+  if (GNUNET_YES == empty)
+    return;
+  LOG_DEBUG ("0x%llx: Received HELLO of peer %u\n", bocc->op_id,
+             bocc->peer->id);
+  GST_cache_add_hello (bocc->peer->id, hello);
+  GNUNET_TRANSPORT_get_hello_cancel (bocc->ghh);
+  bocc->ghh = NULL;
+  GST_connection_pool_get_handle_done (bocc->cgh_p1th);
+  bocc->cgh_p1th = NULL;
+  GNUNET_SCHEDULER_cancel (bocc->timeout_task);
+  bocc->timeout_task = NULL;
+  bocc_start_occs (bocc);
+}
+
+
+/**
+ * Callback from cache with the transport handle of the first peer of a bulk
+ * overlay connect operation
+ *
+ * @param cls the bulk overlay connect context
+ * @param ch the handle to CORE. Can be NULL if it is not requested
+ * @param th the handle to TRANSPORT. Can be NULL if it is not requested
+ * @param ignore_ peer identity which is ignored in this callback
+ */
+static void
+bocc_transport_cb (void *cls, struct GNUNET_CORE_Handle *ch,
+                   struct GNUNET_TRANSPORT_Handle *th,
+                   const struct GNUNET_PeerIdentity *ignore_)
+{
+  struct BulkOverlayConnectContext *bocc = cls;
+
+  GNUNET_assert (NULL != bocc->timeout_task);
+  if (NULL == th)
+  {
+    GNUNET_free_non_null (bocc->emsg);
+    GNUNET_asprintf (&bocc->emsg, "0x%llx: Cannot connect to TRANSPORT of "
+                     "peer with id: %u", bocc->op_id, bocc->peer->id);
+    GNUNET_SCHEDULER_cancel (bocc->timeout_task);
+    bocc->timeout_task = GNUNET_SCHEDULER_add_now (&bocc_timeout, bocc);
+    return;
+  }
+  bocc->ghh = GNUNET_TRANSPORT_get_hello (th, &bocc_hello_cb, bocc);
+}
+
+
+/**
+ * Handler for GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT messages
+ *
+ * @param cls NULL
+ * @param client identification of the client
+ * @param message the actual message
+ */
+void
+GST_handle_bulk_overlay_connect (void *cls, struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *message)
+{
+  const struct GNUNET_TESTBED_BulkOverlayConnectMessage *msg;
+  const struct GNUNET_TESTBED_BulkOverlayConnectTarget *targets;
+  struct BulkOverlayConnectContext *bocc;
+  struct Peer *peer;
+  uint32_t p1;
+  uint32_t npeers;
+  uint32_t cnt;
+  uint16_t msize;
+
+  msize = ntohs (message->size);
+  if (sizeof (struct GNUNET_TESTBED_BulkOverlayConnectMessage) > msize)
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  msg = (const struct GNUNET_TESTBED_BulkOverlayConnectMessage *) message;
+  npeers = ntohl (msg->npeers);
+  if ((0 == npeers) ||
+      (npeers > GNUNET_TESTBED_BULK_OVERLAY_CONNECT_MAX) ||
+      (msize != sizeof (struct GNUNET_TESTBED_BulkOverlayConnectMessage)
+       + npeers * sizeof (struct GNUNET_TESTBED_BulkOverlayConnectTarget)))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  p1 = ntohl (msg->peer1);
+  if (!VALID_PEER_ID (p1))
+  {
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  peer = GST_peer_list[p1];
+  targets = (const struct GNUNET_TESTBED_BulkOverlayConnectTarget *) &msg[1];
+  for (cnt = 0; cnt < npeers; cnt++)
+  {
+    if (VALID_HOST_ID (ntohl (targets[cnt].peer2_host_id)))
+      continue;
+    if ((GNUNET_NO == peer->is_remote) &&
+        (VALID_PEER_ID (ntohl (targets[cnt].peer2))))
+      continue;
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+    return;
+  }
+  LOG_DEBUG ("Received bulk overlay connect for peer %u and %u other peers "
+             "with op id: 0x%llx\n", p1, npeers,
+             GNUNET_ntohll (msg->operation_id));
+  if (GNUNET_YES == peer->is_remote)
+  {
+    forward_bulk_overlay_connect (msg, client);
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
+  bocc = GNUNET_new (struct BulkOverlayConnectContext);
+  GNUNET_SERVER_client_keep (client);
+  bocc->client = client;
+  peer->reference_cnt++;
+  bocc->peer = peer;
+  bocc->op_id = GNUNET_ntohll (msg->operation_id);
+  bocc->ntotal = npeers;
+  bocc->targets =
+      GNUNET_malloc (npeers
+                     * sizeof (struct GNUNET_TESTBED_BulkOverlayConnectTarget));
+  memcpy (bocc->targets, targets,
+          npeers * sizeof (struct GNUNET_TESTBED_BulkOverlayConnectTarget));
+  GNUNET_CONTAINER_DLL_insert_tail (boccq_head, boccq_tail, bocc);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
+  /* acquire the HELLO of peer 1 once; all overlay connect contexts then find
+     it in the cache */
+  if (NULL != GST_cache_lookup_hello (p1))
+  {
+    bocc_start_occs (bocc);
+    return;
+  }
+  GNUNET_asprintf (&bocc->emsg,
+                   "0x%llx: Timeout while acquiring HELLO of peer with id: %u",
+                   bocc->op_id, p1);
+  bocc->timeout_task =
+      GNUNET_SCHEDULER_add_delayed (GST_timeout, &bocc_timeout, bocc);
+  bocc->cgh_p1th =
+      GST_connection_pool_get_handle (p1, peer->details.local.cfg,
+                                      GST_CONNECTIONPOOL_SERVICE_TRANSPORT,
+                                      &bocc_transport_cb, bocc,
+                                      NULL, NULL, NULL);
 }
 
 
@@ -1779,9 +2439,12 @@ void
 GST_free_occq ()
 {
   struct OverlayConnectContext *occ;
+  struct BulkOverlayConnectContext *bocc;
 
   while (NULL != (occ = occq_head))
     cleanup_occ (occ);
+  while (NULL != (bocc = boccq_head))
+    cleanup_bocc (bocc);
 }
 
 
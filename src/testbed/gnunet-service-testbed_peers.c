@@ -132,6 +132,89 @@ struct PeerReconfigureContext
   uint8_t stopped;
 };
 
+/**
+ * Context for a peer start that waits for its peer's ARM to come up
+ * (see MAX_PARALLEL_PEER_STARTS).
+ */
+struct PeerStartContext
+{
+  /**
+   * DLL next ptr
+   */
+  struct PeerStartContext *next;
+
+  /**
+   * DLL prev ptr
+   */
+  struct PeerStartContext *prev;
+
+  /**
+   * The peer to start
+   */
+  struct Peer *peer;
+
+  /**
+   * The client which requested the peer start
+   */
+  struct GNUNET_SERVER_Client *client;
+
+  /**
+   * Handle for testing if the peer's ARM is up; NULL if not testing
+   */
+  struct GNUNET_CLIENT_TestHandle *th;
+
+  /**
+   * Task to test again if the peer's ARM is up
+   */
+  struct GNUNET_SCHEDULER_Task *retry_task;
+
+  /**
+   * Until when do we wait for the peer's ARM?
+   */
+  struct GNUNET_TIME_Absolute deadline;
+
+  /**
+   * The id of the operation
+   */
+  uint64_t op_id;
+};
+
+/**
+ * DLL head for peer starts waiting for a free slot
+ */
+static struct PeerStartContext *psc_wait_head;
+
+/**
+ * DLL tail for peer starts waiting for a free slot
+ */
+static struct PeerStartContext *psc_wait_tail;
+
+/**
+ * DLL head for peers which are being started
+ */
+static struct PeerStartContext *psc_boot_head;
+
+/**
+ * DLL tail for peers which are being started
+ */
+static struct PeerStartContext *psc_boot_tail;
+
+/**
+ * Number of peers which are being started
+ */
+static unsigned int psc_boot_count;
+
+/**
+ * Maximum number of peers we start in parallel; 0 for no limit.  Read
+ * from the configuration when the first peer is started.
+ */
+static unsigned long long max_parallel_starts;
+
+/**
+ * Did we read #max_parallel_starts yet?
+ */
+static int max_parallel_starts_read;
+
 /**
  * The DLL head for the peer reconfigure list
  */
@@ -526,6 +609,181 @@ stop_peer (struct Peer *peer)
 }
 
 
+/**
+ * Send the reply for a successful peer start
+ *
+ * @param client the client which requested the start
+ * @param peer_id the id of the peer (in NBO)
+ * @param op_id the id of the operation (in NBO)
+ */
+static void
+send_peer_start_reply (struct GNUNET_SERVER_Client *client,
+                       uint32_t peer_id,
+                       uint64_t op_id)
+{
+  struct GNUNET_TESTBED_PeerEventMessage *reply;
+
+  reply = GNUNET_new (struct GNUNET_TESTBED_PeerEventMessage);
+  reply->header.type = htons (GNUNET_MESSAGE_TYPE_TESTBED_PEER_EVENT);
+  reply->header.size = htons (sizeof (struct GNUNET_TESTBED_PeerEventMessage));
+  reply->event_type = htonl (GNUNET_TESTBED_ET_PEER_START);
+  reply->host_id = htonl (GST_context->host_id);
+  reply->peer_id = peer_id;
+  reply->operation_id = op_id;
+  GST_queue_message (client, &reply->header);
+}
+
+
+/**
+ * Cleans up the given PeerStartContext and starts waiting peers if a
+ * slot became free
+ *
+ * @param psc the PeerStartContext
+ * @param booting GNUNET_YES if the context is in the booting list
+ */
+static void
+cleanup_psc (struct PeerStartContext *psc,
+             int booting);
+
+
+/**
+ * Start waiting peers while we have free slots
+ */
+static void
+process_start_queue ();
+
+
+/**
+ * Test (again) if the peer's ARM is up.
+ *
+ * @param cls the PeerStartContext
+ * @param tc scheduler task context
+ */
+static void
+psc_test_arm (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Called with the result of testing if the peer's ARM is up.
+ *
+ * @param cls the PeerStartContext
+ * @param result GNUNET_YES if ARM is running, GNUNET_NO if not (yet),
+ *          GNUNET_SYSERR on error
+ */
+static void
+psc_arm_test_cb (void *cls,
+                 int result)
+{
+  struct PeerStartContext *psc = cls;
+
+  psc->th = NULL;
+  if ( (GNUNET_NO == result) &&
+       (0 != GNUNET_TIME_absolute_get_remaining (psc->deadline).rel_value_us) )
+  {
+    psc->retry_task =
+        GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply
+                                      (GNUNET_TIME_UNIT_MILLISECONDS, 100),
+                                      &psc_test_arm, psc);
+    return;
+  }
+  if (GNUNET_YES != result)
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "ARM of peer %u did not come up in time\n", psc->peer->id);
+  /* the peer process is running in any case; report the start */
+  send_peer_start_reply (psc->client, htonl (psc->peer->id),
+                         GNUNET_htonll (psc->op_id));
+  cleanup_psc (psc, GNUNET_YES);
+  process_start_queue ();
+}
+
+
+/**
+ * Test (again) if the peer's ARM is up.
+ *
+ * @param cls the PeerStartContext
+ * @param tc scheduler task context
+ */
+static void
+psc_test_arm (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct PeerStartContext *psc = cls;
+
+  psc->retry_task = NULL;
+  psc->th = GNUNET_CLIENT_service_test ("arm",
+                                        psc->peer->details.local.cfg,
+                                        GNUNET_TIME_absolute_get_remaining (psc->deadline),
+                                        &psc_arm_test_cb,
+                                        psc);
+}
+
+
+static void
+cleanup_psc (struct PeerStartContext *psc,
+             int booting)
+{
+  if (GNUNET_YES == booting)
+  {
+    GNUNET_CONTAINER_DLL_remove (psc_boot_head, psc_boot_tail, psc);
+    psc_boot_count--;
+  }
+  else
+  {
+    GNUNET_CONTAINER_DLL_remove (psc_wait_head, psc_wait_tail, psc);
+  }
+  if (NULL != psc->th)
+    GNUNET_CLIENT_service_test_cancel (psc->th);
+  if (NULL != psc->retry_task)
+    GNUNET_SCHEDULER_cancel (psc->retry_task);
+  GNUNET_SERVER_client_drop (psc->client);
+  GNUNET_assert (0 < psc->peer->reference_cnt);
+  psc->peer->reference_cnt--;
+  if ( (GNUNET_YES == psc->peer->destroy_flag)
+       && (0 == psc->peer->reference_cnt) )
+    GST_destroy_peer (psc->peer);
+  GNUNET_free (psc);
+}
+
+
+static void
+process_start_queue ()
+{
+  struct PeerStartContext *psc;
+
+  while ( (NULL != (psc = psc_wait_head)) &&
+          (psc_boot_count < max_parallel_starts) )
+  {
+    if ( (GNUNET_YES == psc->peer->destroy_flag) ||
+         (GNUNET_OK != start_peer (psc->peer)) )
+    {
+      GST_send_operation_fail_msg (psc->client, psc->op_id,
+                                   "Failed to start");
+      cleanup_psc (psc, GNUNET_NO);
+      continue;
+    }
+    GNUNET_CONTAINER_DLL_remove (psc_wait_head, psc_wait_tail, psc);
+    GNUNET_CONTAINER_DLL_insert_tail (psc_boot_head, psc_boot_tail, psc);
+    psc_boot_count++;
+    psc->deadline = GNUNET_TIME_relative_to_absolute (GST_timeout);
+    psc->retry_task = GNUNET_SCHEDULER_add_now (&psc_test_arm, psc);
+  }
+}
+
+
+/**
+ * Frees the peer start queue
+ */
+void
+GST_free_pscq ()
+{
+  while (NULL != psc_boot_head)
+    cleanup_psc (psc_boot_head, GNUNET_YES);
+  while (NULL != psc_wait_head)
+    cleanup_psc (psc_wait_head, GNUNET_NO);
+}
+
+
 /**
  * Message handler for GNUNET_MESSAGE_TYPE_TESTBED_DESTROYPEER messages
  *
@@ -538,8 +796,8 @@ GST_handle_peer_start (void *cls, struct GNUNET_SERVER_Client *client,
                        const struct GNUNET_MessageHeader *message)
 {
   const struct GNUNET_TESTBED_PeerStartMessage *msg;
-  struct GNUNET_TESTBED_PeerEventMessage *reply;
   struct ForwardedOperationContext *fopc;
+  struct PeerStartContext *psc;
   struct Peer *peer;
   uint32_t peer_id;
 
@@ -574,6 +832,29 @@ GST_handle_peer_start (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_SERVER_receive_done (client, GNUNET_OK);
     return;
   }
+  if (GNUNET_NO == max_parallel_starts_read)
+  {
+    max_parallel_starts_read = GNUNET_YES;
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (GST_config, "TESTBED",
+                                               "MAX_PARALLEL_PEER_STARTS",
+                                               &max_parallel_starts))
+      max_parallel_starts = 0;
+  }
+  if (0 != max_parallel_starts)
+  {
+    /* queue the start; it is reported once the peer's ARM is up */
+    psc = GNUNET_new (struct PeerStartContext);
+    psc->peer = peer;
+    peer->reference_cnt++;
+    GNUNET_SERVER_client_keep (client);
+    psc->client = client;
+    psc->op_id = GNUNET_ntohll (msg->operation_id);
+    GNUNET_CONTAINER_DLL_insert_tail (psc_wait_head, psc_wait_tail, psc);
+    process_start_queue ();
+    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    return;
+  }
   if (GNUNET_OK != start_peer (peer))
   {
     GST_send_operation_fail_msg (client, GNUNET_ntohll (msg->operation_id),
@@ -581,14 +862,7 @@ GST_handle_peer_start (void *cls, struct GNUNET_SERVER_Client *client,
     GNUNET_SERVER_receive_done (client, GNUNET_OK);
     return;
   }
-  reply = GNUNET_new (struct GNUNET_TESTBED_PeerEventMessage);
-  reply->header.type = htons (GNUNET_MESSAGE_TYPE_TESTBED_PEER_EVENT);
-  reply->header.size = htons (sizeof (struct GNUNET_TESTBED_PeerEventMessage));
-  reply->event_type = htonl (GNUNET_TESTBED_ET_PEER_START);
-  reply->host_id = htonl (GST_context->host_id);
-  reply->peer_id = msg->peer_id;
-  reply->operation_id = msg->operation_id;
-  GST_queue_message (client, &reply->header);
+  send_peer_start_reply (client, msg->peer_id, msg->operation_id);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -424,6 +424,99 @@ struct GNUNET_TESTBED_OverlayConnectMessage
 };
 
 
+/**
+ * A peer to be connected in a bulk overlay connect message
+ */
+struct GNUNET_TESTBED_BulkOverlayConnectTarget
+{
+  /**
+   * Unique ID of the peer
+   */
+  uint32_t peer2 GNUNET_PACKED;
+
+  /**
+   * The ID of the host which runs the peer
+   */
+  uint32_t peer2_host_id GNUNET_PACKED;
+};
+
+
+/**
+ * Message sent from client to testbed service to connect a number of peers to
+ * the same first peer in the overlay.  The HELLO of the first peer is
+ * acquired once and offered to all the other peers.
+ */
+struct GNUNET_TESTBED_BulkOverlayConnectMessage
+{
+  /**
+   * Type is #GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Unique ID for the first peer.
+   */
+  uint32_t peer1 GNUNET_PACKED;
+
+  /**
+   * Operation ID that is used to identify this operation.
+   */
+  uint64_t operation_id GNUNET_PACKED;
+
+  /**
+   * The number of struct GNUNET_TESTBED_BulkOverlayConnectTarget following
+   * this message
+   */
+  uint32_t npeers GNUNET_PACKED;
+
+  /* followed by npeers struct GNUNET_TESTBED_BulkOverlayConnectTarget */
+};
+
+
+/**
+ * The maximum number of peers which can be connected to a peer through one
+ * bulk overlay connect message
+ */
+#define GNUNET_TESTBED_BULK_OVERLAY_CONNECT_MAX                         \
+  ((GNUNET_SERVER_MAX_MESSAGE_SIZE - 1                                  \
+    - sizeof (struct GNUNET_TESTBED_BulkOverlayConnectMessage))         \
+   / sizeof (struct GNUNET_TESTBED_BulkOverlayConnectTarget))
+
+
+/**
+ * Message sent from testbed service to client to report the progress of a bulk
+ * overlay connect operation.  The operation is finished when the number of
+ * completed and failed connections add up to the total.
+ */
+struct GNUNET_TESTBED_BulkOverlayConnectProgressMessage
+{
+  /**
+   * Type is #GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * The number of overlay connections established so far
+   */
+  uint32_t ncompleted GNUNET_PACKED;
+
+  /**
+   * The number of overlay connections which failed so far
+   */
+  uint32_t nfailed GNUNET_PACKED;
+
+  /**
+   * The total number of overlay connections in the operation
+   */
+  uint32_t ntotal GNUNET_PACKED;
+
+  /**
+   * Operation ID of the bulk overlay connect operation
+   */
+  uint64_t operation_id GNUNET_PACKED;
+};
+
+
 /**
  * Message sent from host controller of a peer(A) to the host controller of
  * another peer(B) to request B to connect to A
@@ -902,6 +995,39 @@ struct GNUNET_TESTBED_BarrierWait
 };
 
 
+/**
+ * Message sent from a controller to its parent to report the load of the host
+ * it is running on.  All load values are percentages.
+ */
+struct GNUNET_TESTBED_HostLoadMessage
+{
+  /**
+   * Type is GNUNET_MESSAGE_TYPE_TESTBED_HOST_LOAD
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * The id of the host the load is reported for
+   */
+  uint32_t host_id GNUNET_PACKED;
+
+  /**
+   * CPU load
+   */
+  uint32_t cpu_load GNUNET_PACKED;
+
+  /**
+   * Memory usage
+   */
+  uint32_t mem_usage GNUNET_PACKED;
+
+  /**
+   * File descriptor usage with respect to the process limit
+   */
+  uint32_t fd_usage GNUNET_PACKED;
+};
+
+
 GNUNET_NETWORK_STRUCT_END
 #endif
 /* end of testbed.h */
@@ -698,6 +698,91 @@ handle_peer_conevent (struct GNUNET_TESTBED_Controller *c,
 }
 
 
+/**
+ * Handler for GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS message
+ * from controller (testbed service)
+ *
+ * @param c the controller handler
+ * @param msg message received
+ * @return GNUNET_YES if we can continue receiving from service; GNUNET_NO if
+ *           not
+ */
+static int
+handle_bulk_overlay_connect_progress (struct GNUNET_TESTBED_Controller *c,
+                                      const struct
+                                      GNUNET_TESTBED_BulkOverlayConnectProgressMessage
+                                      *msg)
+{
+  struct OperationContext *opc;
+  struct BulkOverlayConnectData *data;
+  struct ForwardedOperationData *fo_data;
+  GNUNET_TESTBED_OverlayConnectProgressCallback cb;
+  void *cb_cls;
+  struct GNUNET_TESTBED_EventInformation event;
+  uint64_t op_id;
+  uint64_t mask;
+  unsigned int ncompleted;
+  unsigned int nfailed;
+  unsigned int ntotal;
+
+  op_id = GNUNET_ntohll (msg->operation_id);
+  if (NULL == (opc = find_opc (c, op_id)))
+  {
+    LOG_DEBUG ("Operation not found\n");
+    return GNUNET_YES;
+  }
+  ncompleted = ntohl (msg->ncompleted);
+  nfailed = ntohl (msg->nfailed);
+  ntotal = ntohl (msg->ntotal);
+  if (OP_FORWARDED == opc->type)
+  {
+    if (ncompleted + nfailed >= ntotal)
+    {
+      handle_forwarded_operation_msg (c, opc,
+                                      (const struct GNUNET_MessageHeader *) msg);
+      return GNUNET_YES;
+    }
+    /* intermediate progress; the forwarded operation is still running */
+    fo_data = opc->data;
+    if (NULL != fo_data->cc)
+      fo_data->cc (fo_data->cc_cls, (const struct GNUNET_MessageHeader *) msg);
+    return GNUNET_YES;
+  }
+  GNUNET_assert (OP_BULK_OVERLAY_CONNECT == opc->type);
+  GNUNET_assert (NULL != (data = opc->data));
+  cb = data->cb;
+  cb_cls = data->cb_cls;
+  if (ncompleted + nfailed < ntotal)
+  {
+    if (NULL != cb)
+      cb (cb_cls, opc->op, ncompleted, nfailed, ntotal, NULL);
+    return GNUNET_YES;
+  }
+  GNUNET_TESTBED_remove_opc_ (opc->c, opc);
+  opc->state = OPC_STATE_FINISHED;
+  if (0 != nfailed)
+    GNUNET_TESTBED_operation_mark_failed (opc->op);
+  event.type = GNUNET_TESTBED_ET_OPERATION_FINISHED;
+  event.op = opc->op;
+  event.op_cls = opc->op_cls;
+  event.details.operation_finished.emsg = NULL;
+  event.details.operation_finished.generic = NULL;
+  exop_insert (event.op);
+  mask = 1LL << GNUNET_TESTBED_ET_OPERATION_FINISHED;
+  if ((0 != (mask & c->event_mask)) && (NULL != c->cc))
+  {
+    c->cc (c->cc_cls, &event);
+    if (GNUNET_NO == exop_check (event.op))
+      return GNUNET_YES;
+  }
+  if (NULL != cb)
+    cb (cb_cls, opc->op, ncompleted, nfailed, ntotal, NULL);
+  /* You could have marked the operation as done by now */
+  GNUNET_break (GNUNET_NO == exop_check (event.op));
+  return GNUNET_YES;
+}
+
+
 /**
  * Handler for GNUNET_MESSAGE_TYPE_TESTBED_PEERCONFIG message from
  * controller (testbed service)
@@ -868,6 +953,16 @@ handle_op_fail_event (struct GNUNET_TESTBED_Controller *c,
       data->cb (data->cb_cls, opc->op, emsg);
   }
     break;
+  case OP_BULK_OVERLAY_CONNECT:
+  {
+    struct BulkOverlayConnectData *data;
+
+    data = opc->data;
+    GNUNET_TESTBED_operation_mark_failed (opc->op);
+    if (NULL != data->cb)
+      data->cb (data->cb_cls, opc->op, 0, data->npeers, data->npeers, emsg);
+  }
+    break;
   case OP_FORWARDED:
     GNUNET_assert (0);
   case OP_LINK_CONTROLLERS:    /* No secondary callback */
@@ -1063,6 +1158,55 @@ handle_link_controllers_result (struct GNUNET_TESTBED_Controller *c,
 }
 
 
+/**
+ * Handler for GNUNET_MESSAGE_TYPE_TESTBED_HOST_LOAD message from controller
+ * (testbed service)
+ *
+ * @param c the controller handler
+ * @param msg message received
+ * @return GNUNET_YES if we can continue receiving from service; GNUNET_NO if
+ *           not
+ */
+static int
+handle_host_load (struct GNUNET_TESTBED_Controller *c,
+                  const struct GNUNET_TESTBED_HostLoadMessage *msg)
+{
+  struct GNUNET_TESTBED_Host *host;
+  unsigned int load;
+
+  host = GNUNET_TESTBED_host_lookup_by_id_ (ntohl (msg->host_id));
+  if (NULL != host)
+  {
+    load = GNUNET_MAX (ntohl (msg->cpu_load), ntohl (msg->mem_usage));
+    load = GNUNET_MAX (load, ntohl (msg->fd_usage));
+    LOG_DEBUG ("Load of host %u is %u%%\n", ntohl (msg->host_id), load);
+    GNUNET_TESTBED_host_set_load_ (host, load);
+  }
+  if (NULL != c->load_relay)
+    c->load_relay (c->load_relay_cls, msg);
+  return GNUNET_YES;
+}
+
+
+/**
+ * Sets the callback to which host load reports received from the given
+ * controller are relayed after they are applied to the operation queues of
+ * the reported host
+ *
+ * @param c the controller handle
+ * @param relay the callback; NULL to stop relaying
+ * @param relay_cls closure for the above callback
+ */
+void
+GNUNET_TESTBED_controller_set_load_relay_ (struct GNUNET_TESTBED_Controller *c,
+                                           TESTBED_host_load_relay relay,
+                                           void *relay_cls)
+{
+  c->load_relay = relay;
+  c->load_relay_cls = relay_cls;
+}
+
+
 /**
  * Handler for messages from controller (testbed service)
  *
@@ -1169,6 +1313,22 @@ message_handler (void *cls, const struct GNUNET_MessageHeader *msg)
                                                 GNUNET_TESTBED_BarrierStatusMsg *)
                                                msg);
     break;
+  case GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT_PROGRESS:
+    GNUNET_assert (msize ==
+                   sizeof (struct
+                           GNUNET_TESTBED_BulkOverlayConnectProgressMessage));
+    status =
+        handle_bulk_overlay_connect_progress (c,
+                                              (const struct
+                                               GNUNET_TESTBED_BulkOverlayConnectProgressMessage
+                                               *) msg);
+    break;
+  case GNUNET_MESSAGE_TYPE_TESTBED_HOST_LOAD:
+    GNUNET_assert (msize == sizeof (struct GNUNET_TESTBED_HostLoadMessage));
+    status =
+        handle_host_load (c,
+                          (const struct GNUNET_TESTBED_HostLoadMessage *) msg);
+    break;
   default:
     GNUNET_assert (0);
   }
@@ -101,7 +101,12 @@ enum OperationType
   /**
    * Start/stop service at a peer
    */
-  OP_MANAGE_SERVICE
+  OP_MANAGE_SERVICE,
+
+  /**
+   * Connect a list of peers to a peer in the overlay
+   */
+  OP_BULK_OVERLAY_CONNECT
 };
 
 
@@ -186,6 +191,17 @@ struct OperationContext
 typedef void (*TESTBED_opcq_empty_cb) (void *cls);
 
 
+/**
+ * Callback to relay a host load report received from a controller
+ *
+ * @param cls closure
+ * @param msg the host load report
+ */
+typedef void (*TESTBED_host_load_relay) (void *cls,
+                                         const struct
+                                         GNUNET_TESTBED_HostLoadMessage *msg);
+
+
 /**
  * Handle to interact with a GNUnet testbed controller.  Each
  * controller has at least one master handle which is created when the
@@ -283,6 +299,16 @@ struct GNUNET_TESTBED_Controller
    */
   int in_receive;
 
+  /**
+   * Callback to relay the host load reports received from this controller
+   */
+  TESTBED_host_load_relay load_relay;
+
+  /**
+   * Closure for the above callback
+   */
+  void *load_relay_cls;
+
   /**
    * The operation id counter. use current value and increment
    */
@@ -291,6 +317,21 @@ struct GNUNET_TESTBED_Controller
 };
 
 
+/**
+ * Sets the callback to which host load reports received from the given
+ * controller are relayed after they are applied to the operation queues of
+ * the reported host
+ *
+ * @param c the controller handle
+ * @param relay the callback; NULL to stop relaying
+ * @param relay_cls closure for the above callback
+ */
+void
+GNUNET_TESTBED_controller_set_load_relay_ (struct GNUNET_TESTBED_Controller *c,
+                                           TESTBED_host_load_relay relay,
+                                           void *relay_cls);
+
+
 /**
  * Queues a message in send queue for sending to the service
  *
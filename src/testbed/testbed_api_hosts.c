@@ -138,6 +138,13 @@ struct GNUNET_TESTBED_Host
    */
   struct OperationQueue *opq_parallel_overlay_connect_operations;
 
+  /**
+   * Operation queue for operations which consume the resources of this host,
+   * such as peer starts and service connects.  Its parallelism follows the
+   * load reported by the controller running on this host
+   */
+  struct OperationQueue *opq_load;
+
   /**
    * Is a controller started on this host? FIXME: Is this needed?
    */
@@ -340,6 +347,9 @@ GNUNET_TESTBED_host_create_with_id (uint32_t id, const char *hostname,
   host->opq_parallel_overlay_connect_operations =
       GNUNET_TESTBED_operation_queue_create_ (OPERATION_QUEUE_TYPE_ADAPTIVE,
                                               UINT_MAX);
+  host->opq_load =
+      GNUNET_TESTBED_operation_queue_create_ (OPERATION_QUEUE_TYPE_FIXED,
+                                              UINT_MAX);
   new_size = host_list_size;
   while (id >= new_size)
     new_size += HOST_LIST_GROW_STEP;
@@ -608,6 +618,7 @@ GNUNET_TESTBED_host_destroy (struct GNUNET_TESTBED_Host *host)
   GNUNET_free_non_null ((char *) host->hostname);
   GNUNET_TESTBED_operation_queue_destroy_
       (host->opq_parallel_overlay_connect_operations);
+  GNUNET_TESTBED_operation_queue_destroy_ (host->opq_load);
   GNUNET_CONFIGURATION_destroy (host->cfg);
   GNUNET_free (host);
   while (host_list_size >= HOST_LIST_GROW_STEP)
@@ -1534,6 +1545,38 @@ GNUNET_TESTBED_host_queue_oc_ (struct GNUNET_TESTBED_Host *h,
 }
 
 
+/**
+ * Queues the given operation in the queue for operations consuming the
+ * resources of the given host
+ *
+ * @param h the host handle
+ * @param op the operation to queue
+ */
+void
+GNUNET_TESTBED_host_queue_load_ (struct GNUNET_TESTBED_Host *h,
+                                 struct GNUNET_TESTBED_Operation *op)
+{
+  GNUNET_TESTBED_operation_queue_insert_ (h->opq_load, op);
+}
+
+
+/**
+ * Adapts the parallelism of the operations targeted at the given host to the
+ * load reported for it
+ *
+ * @param h the host handle
+ * @param load the load of the host in percent of its scarcest resource
+ */
+void
+GNUNET_TESTBED_host_set_load_ (struct GNUNET_TESTBED_Host *h,
+                               unsigned int load)
+{
+  GNUNET_TESTBED_operation_queue_set_load_ (h->opq_load, load);
+  GNUNET_TESTBED_operation_queue_set_load_
+      (h->opq_parallel_overlay_connect_operations, load);
+}
+
+
 /**
  * Handler for GNUNET_MESSAGE_TYPE_TESTBED_ADDHOSTCONFIRM message from
  * controller (testbed service)
@@ -163,6 +163,30 @@ GNUNET_TESTBED_host_queue_oc_ (struct GNUNET_TESTBED_Host *h,
                                struct GNUNET_TESTBED_Operation *op);
 
 
+/**
+ * Queues the given operation in the queue for operations consuming the
+ * resources of the given host
+ *
+ * @param h the host handle
+ * @param op the operation to queue
+ */
+void
+GNUNET_TESTBED_host_queue_load_ (struct GNUNET_TESTBED_Host *h,
+                                 struct GNUNET_TESTBED_Operation *op);
+
+
+/**
+ * Adapts the parallelism of the operations targeted at the given host to the
+ * load reported for it
+ *
+ * @param h the host handle
+ * @param load the load of the host in percent of its scarcest resource
+ */
+void
+GNUNET_TESTBED_host_set_load_ (struct GNUNET_TESTBED_Host *h,
+                               unsigned int load);
+
+
 /**
  * Handler for GNUNET_MESSAGE_TYPE_TESTBED_ADDHOSTCONFIRM message from
  * controller (testbed service)
@@ -41,6 +41,18 @@
  */
 #define ADAPTIVE_QUEUE_DEFAULT_MAX_ACTIVE 4
 
+/**
+ * Host load (in percent of the scarcest resource) above which we do not
+ * increase the parallelism of a queue any further
+ */
+#define LOAD_HIGH_WATERMARK 70
+
+/**
+ * Host load (in percent of the scarcest resource) above which we halve
+ * the parallelism of a queue
+ */
+#define LOAD_OVERLOAD_WATERMARK 90
+
 /**
  * An entry in the operation queue
  */
@@ -241,6 +253,17 @@ struct OperationQueue
    * Is this queue marked for expiry?
    */
   unsigned int expired;
+
+  /**
+   * The last reported load of the host whose resources this queue
+   * guards (in percent); 0 if unknown
+   */
+  unsigned int load;
+
+  /**
+   * The maximum number of active operations the queue was created with
+   */
+  unsigned int max_active_bound;
 };
 
 
@@ -933,6 +956,11 @@ adapt_parallelism (struct OperationQueue *queue)
   if (2 <= sd)
     parallelism = queue->max_active / 2;
   parallelism = GNUNET_MAX (parallelism, ADAPTIVE_QUEUE_DEFAULT_MAX_ACTIVE);
+  /* the host's load overrides what the completion times suggest */
+  if (queue->load >= LOAD_OVERLOAD_WATERMARK)
+    parallelism = GNUNET_MAX (1, queue->max_active / 2);
+  else if (queue->load >= LOAD_HIGH_WATERMARK)
+    parallelism = GNUNET_MIN (parallelism, queue->max_active);
   adaptive_queue_set_max_active (queue, parallelism);
 
 #if 0
@@ -1050,6 +1078,7 @@ GNUNET_TESTBED_operation_queue_create_ (enum OperationQueueType type,
 
   queue = GNUNET_new (struct OperationQueue);
   queue->type = type;
+  queue->max_active_bound = max_active;
   if (OPERATION_QUEUE_TYPE_FIXED == type)
   {
     queue->max_active = max_active;
@@ -1171,6 +1200,53 @@ GNUNET_TESTBED_operation_queue_reset_max_active_ (struct OperationQueue *queue,
 }
 
 
+/**
+ * Inform a queue about the load of the host whose resources it guards.
+ * Under overload the parallelism of the queue is halved (down to one
+ * operation); under high load it is not increased any further; otherwise
+ * a fixed queue doubles its parallelism again up to the value it was
+ * created with and an adaptive queue is left to its timing feedback.
+ *
+ * @param queue the operation queue
+ * @param load the load of the host in percent of its scarcest resource
+ */
+void
+GNUNET_TESTBED_operation_queue_set_load_ (struct OperationQueue *queue,
+                                          unsigned int load)
+{
+  unsigned int max_active;
+
+  queue->load = load;
+  max_active = queue->max_active;
+  if (load >= LOAD_OVERLOAD_WATERMARK)
+  {
+    max_active = GNUNET_MIN (max_active, GNUNET_MAX (queue->active, 1));
+    max_active = GNUNET_MAX (1, max_active / 2);
+  }
+  else if (load >= LOAD_HIGH_WATERMARK)
+  {
+    return;
+  }
+  else if (OPERATION_QUEUE_TYPE_FIXED == queue->type)
+  {
+    if (max_active >= queue->max_active_bound / 2)
+      max_active = queue->max_active_bound;
+    else
+      max_active *= 2;
+  }
+  else
+  {
+    return;
+  }
+  if (max_active == queue->max_active)
+    return;
+  if (OPERATION_QUEUE_TYPE_ADAPTIVE == queue->type)
+    adaptive_queue_set_max_active (queue, max_active);
+  else
+    GNUNET_TESTBED_operation_queue_reset_max_active_ (queue, max_active);
+}
+
+
 /**
  * Add an operation to a queue.  An operation can be in multiple queues at
  * once. Once the operation is inserted into all the queues
@@ -103,6 +103,19 @@ GNUNET_TESTBED_operation_queue_reset_max_active_ (struct OperationQueue *queue,
                                                   unsigned int max_active);
 
 
+/**
+ * Inform a queue about the load of the host whose resources it guards.
+ * Under overload the parallelism of the queue is reduced, under low load
+ * it is allowed to grow again.
+ *
+ * @param queue the operation queue
+ * @param load the load of the host in percent of its scarcest resource
+ */
+void
+GNUNET_TESTBED_operation_queue_set_load_ (struct OperationQueue *queue,
+                                          unsigned int load);
+
+
 /**
  * Add an operation to a queue.  An operation can be in multiple queues at
  * once. Once the operation is inserted into all the queues
@@ -450,6 +450,76 @@ oprelease_overlay_connect (void *cls)
 }
 
 
+/**
+ * Function called when a bulk overlay connect operation is ready
+ *
+ * @param cls the closure from GNUNET_TESTBED_operation_create_()
+ */
+static void
+opstart_bulk_overlay_connect (void *cls)
+{
+  struct OperationContext *opc = cls;
+  struct GNUNET_TESTBED_BulkOverlayConnectMessage *msg;
+  struct GNUNET_TESTBED_BulkOverlayConnectTarget *targets;
+  struct BulkOverlayConnectData *data;
+  unsigned int cnt;
+  uint16_t msize;
+
+  opc->state = OPC_STATE_STARTED;
+  data = opc->data;
+  GNUNET_assert (NULL != data);
+  msize = sizeof (struct GNUNET_TESTBED_BulkOverlayConnectMessage)
+      + data->npeers * sizeof (struct GNUNET_TESTBED_BulkOverlayConnectTarget);
+  msg = GNUNET_malloc (msize);
+  msg->header.size = htons (msize);
+  msg->header.type = htons (GNUNET_MESSAGE_TYPE_TESTBED_BULK_OVERLAY_CONNECT);
+  msg->peer1 = htonl (data->p1->unique_id);
+  msg->operation_id = GNUNET_htonll (opc->id);
+  msg->npeers = htonl (data->npeers);
+  targets = (struct GNUNET_TESTBED_BulkOverlayConnectTarget *) &msg[1];
+  for (cnt = 0; cnt < data->npeers; cnt++)
+  {
+    targets[cnt].peer2 = htonl (data->peers[cnt]->unique_id);
+    targets[cnt].peer2_host_id =
+        htonl (GNUNET_TESTBED_host_get_id_ (data->peers[cnt]->host));
+  }
+  GNUNET_TESTBED_insert_opc_ (opc->c, opc);
+  GNUNET_TESTBED_queue_message_ (opc->c, &msg->header);
+}
+
+
+/**
+ * Callback which will be called when bulk overlay connect operation is
+ * released
+ *
+ * @param cls the closure from GNUNET_TESTBED_operation_create_()
+ */
+static void
+oprelease_bulk_overlay_connect (void *cls)
+{
+  struct OperationContext *opc = cls;
+  struct BulkOverlayConnectData *data;
+
+  data = opc->data;
+  switch (opc->state)
+  {
+  case OPC_STATE_INIT:
+    break;
+  case OPC_STATE_STARTED:
+    GNUNET_TESTBED_remove_opc_ (opc->c, opc);
+    break;
+  case OPC_STATE_FINISHED:
+    break;
+  }
+  if (NULL != data)
+  {
+    GNUNET_free (data->peers);
+    GNUNET_free (data);
+  }
+  GNUNET_free (opc);
+}
+
+
 /**
  * Function called when a peer reconfigure operation is ready
  *
@@ -628,6 +698,7 @@ GNUNET_TESTBED_peer_start (void *op_cls, struct GNUNET_TESTBED_Peer *peer,
                                         &oprelease_peer_start);
   GNUNET_TESTBED_operation_queue_insert_ (opc->c->opq_parallel_operations,
                                           opc->op);
+  GNUNET_TESTBED_host_queue_load_ (peer->host, opc->op);
   GNUNET_TESTBED_operation_begin_wait_ (opc->op);
   return opc->op;
 }
@@ -863,6 +934,68 @@ GNUNET_TESTBED_overlay_connect (void *op_cls,
 }
 
 
+/**
+ * All peers must have been started before calling this function.  This
+ * function obtains the HELLO of @a p1 once and asks each of the @a npeers
+ * peers in @a peers to connect to @a p1.  Instead of one event per connection
+ * the progress is reported in aggregate to @a cb.  A
+ * #GNUNET_TESTBED_ET_OPERATION_FINISHED event is generated when all
+ * connections have either been established or failed.
+ *
+ * @param op_cls closure argument to give with the operation event
+ * @param cb the callback to call with the progress of this operation
+ * @param cb_cls the closure for @a cb
+ * @param p1 the peer the other peers should connect to
+ * @param npeers the number of peers in @a peers; should not be more than a
+ *          few thousand so that the request fits into a single message
+ * @param peers the peers which should connect to @a p1
+ * @return handle to the operation, NULL if @a npeers is 0 or too large
+ */
+struct GNUNET_TESTBED_Operation *
+GNUNET_TESTBED_overlay_connect_bulk (void *op_cls,
+                                     GNUNET_TESTBED_OverlayConnectProgressCallback
+                                     cb,
+                                     void *cb_cls,
+                                     struct GNUNET_TESTBED_Peer *p1,
+                                     unsigned int npeers,
+                                     struct GNUNET_TESTBED_Peer *const *peers)
+{
+  struct OperationContext *opc;
+  struct BulkOverlayConnectData *data;
+  unsigned int cnt;
+
+  if ((0 == npeers) || (npeers > GNUNET_TESTBED_BULK_OVERLAY_CONNECT_MAX))
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  GNUNET_assert (TESTBED_PS_STARTED == p1->state);
+  data = GNUNET_new (struct BulkOverlayConnectData);
+  data->p1 = p1;
+  data->npeers = npeers;
+  data->peers = GNUNET_malloc (npeers * sizeof (struct GNUNET_TESTBED_Peer *));
+  for (cnt = 0; cnt < npeers; cnt++)
+  {
+    GNUNET_assert (TESTBED_PS_STARTED == peers[cnt]->state);
+    data->peers[cnt] = peers[cnt];
+  }
+  data->cb = cb;
+  data->cb_cls = cb_cls;
+  opc = GNUNET_new (struct OperationContext);
+  opc->data = data;
+  opc->c = p1->controller;
+  opc->id = GNUNET_TESTBED_get_next_op_id (opc->c);
+  opc->type = OP_BULK_OVERLAY_CONNECT;
+  opc->op_cls = op_cls;
+  opc->op =
+      GNUNET_TESTBED_operation_create_ (opc, &opstart_bulk_overlay_connect,
+                                        &oprelease_bulk_overlay_connect);
+  GNUNET_TESTBED_host_queue_oc_ (p1->host, opc->op);
+  GNUNET_TESTBED_operation_begin_wait_ (opc->op);
+  return opc->op;
+}
+
+
 /**
  * Function called when a peer manage service operation is ready
  *
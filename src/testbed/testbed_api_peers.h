@@ -258,6 +258,39 @@ struct OverlayConnectData
 };
 
 
+/**
+ * Data structure for OperationType OP_BULK_OVERLAY_CONNECT
+ */
+struct BulkOverlayConnectData
+{
+  /**
+   * The peer the other peers connect to
+   */
+  struct GNUNET_TESTBED_Peer *p1;
+
+  /**
+   * The peers to connect to p1
+   */
+  struct GNUNET_TESTBED_Peer **peers;
+
+  /**
+   * The callback to report the progress to
+   */
+  GNUNET_TESTBED_OverlayConnectProgressCallback cb;
+
+  /**
+   * The closure for the above callback
+   */
+  void *cb_cls;
+
+  /**
+   * The number of peers in the peers array
+   */
+  unsigned int npeers;
+
+};
+
+
 struct ManageServiceData {
   GNUNET_TESTBED_OperationCompletionCallback cb;
 
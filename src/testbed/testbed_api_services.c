@@ -26,6 +26,7 @@
 #include "platform.h"
 #include "testbed_api.h"
 #include "testbed_api_peers.h"
+#include "testbed_api_hosts.h"
 #include "testbed_api_operations.h"
 
 
@@ -281,6 +282,7 @@ GNUNET_TESTBED_service_connect (void *op_cls, struct GNUNET_TESTBED_Peer *peer,
   GNUNET_TESTBED_operation_queue_insert_ (peer->
                                           controller->opq_parallel_operations,
                                           data->operation);
+  GNUNET_TESTBED_host_queue_load_ (peer->host, data->operation);
   GNUNET_TESTBED_operation_begin_wait_ (data->operation);
   return data->operation;
 }
@@ -78,6 +78,44 @@ struct OverlayLink
 };
 
 
+/**
+ * A batch of overlay links sharing the same peer A which are established
+ * through a single bulk overlay connect operation
+ */
+struct OverlayBatch
+{
+  /**
+   * The bulk overlay connect operation of this batch
+   */
+  struct GNUNET_TESTBED_Operation *op;
+
+  /**
+   * The topology context this batch is a part of
+   */
+  struct TopologyContext *tc;
+
+  /**
+   * The handles of the B peers of the links in this batch
+   */
+  struct GNUNET_TESTBED_Peer **peers;
+
+  /**
+   * The number of links in this batch
+   */
+  unsigned int npeers;
+
+  /**
+   * The number of links established in the best attempt so far
+   */
+  unsigned int nsuccess;
+
+  /**
+   * position of peer A's handle in peers array
+   */
+  uint32_t A;
+};
+
+
 /**
  * Representation of an underlay link
  */
@@ -126,6 +164,11 @@ struct RetryListEntry
    * The link to be retired
    */
   struct OverlayLink *link;
+
+  /**
+   * The batch to be retried if the links are established in batches
+   */
+  struct OverlayBatch *batch;
 };
 
 
@@ -144,6 +187,26 @@ struct TopologyContextOverlay
    */
   struct OverlayLink *link_array;
 
+  /**
+   * An array of link batches; only used if links are established in batches
+   */
+  struct OverlayBatch *batch_array;
+
+  /**
+   * The B peers of all link batches
+   */
+  struct GNUNET_TESTBED_Peer **batch_peers;
+
+  /**
+   * The number of link batches
+   */
+  unsigned int nbatches;
+
+  /**
+   * Should the links be established in batches of bulk overlay connects?
+   */
+  int bulk;
+
   /**
    * The operation closure
    */
@@ -175,12 +238,12 @@ struct TopologyContextOverlay
   unsigned int retry_cnt;
 
   /**
-   * Number of links to try
+   * Number of links (or link batches) to try
    */
   unsigned int nlinks;
 
   /**
-   * How many links have been completed
+   * How many links (or link batches) have been completed
    */
   unsigned int ncompleted;
 
@@ -332,6 +395,17 @@ const char *topology_strings[] = {
 };
 
 
+/**
+ * Called when all the links (or link batches) of the current round have
+ * completed.  Retries the failed ones if we have retries left, otherwise
+ * calls the topology completion callback.
+ *
+ * @param tc the topology context
+ */
+static void
+overlay_round_completed (struct TopologyContext *tc);
+
+
 /**
  * Callback to be called when an overlay_link operation complete
  *
@@ -372,6 +446,100 @@ overlay_link_completed (void *cls, struct GNUNET_TESTBED_Operation *op,
   overlay->ncompleted++;
   if (overlay->ncompleted < overlay->nlinks)
     return;
+  overlay_round_completed (tc);
+}
+
+
+/**
+ * Callback to be called with the progress of the bulk overlay connect
+ * operation of a link batch
+ *
+ * @param cls the batch
+ * @param op the operation
+ * @param ncompleted the number of links established so far
+ * @param nfailed the number of links which failed so far
+ * @param ntotal the number of links in the batch
+ * @param emsg error message if the operation failed as a whole
+ */
+static void
+overlay_batch_progress (void *cls, struct GNUNET_TESTBED_Operation *op,
+                        unsigned int ncompleted, unsigned int nfailed,
+                        unsigned int ntotal, const char *emsg)
+{
+  struct OverlayBatch *batch = cls;
+  struct TopologyContext *tc;
+  struct TopologyContextOverlay *overlay;
+  struct RetryListEntry *retry_entry;
+
+  if ((NULL == emsg) && (ncompleted + nfailed < ntotal))
+    return;
+  GNUNET_assert (op == batch->op);
+  GNUNET_TESTBED_operation_done (op);
+  batch->op = NULL;
+  tc = batch->tc;
+  GNUNET_assert (TOPOLOGYCONTEXT_TYPE_OVERLAY == tc->type);
+  overlay = &tc->u.overlay;
+  /* a retried batch connects its already connected links again */
+  if (ncompleted > batch->nsuccess)
+  {
+    overlay->nsuccess += ncompleted - batch->nsuccess;
+    batch->nsuccess = ncompleted;
+  }
+  if (0 != nfailed)
+  {
+    overlay->nfailures += nfailed;
+    if (0 != overlay->retry_cnt)
+    {
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           "%u of %u links of peer %u failed%s%s -- Retrying\n",
+           nfailed, ntotal, batch->A,
+           (NULL == emsg) ? "" : ": ", (NULL == emsg) ? "" : emsg);
+      retry_entry = GNUNET_new (struct RetryListEntry);
+      retry_entry->batch = batch;
+      GNUNET_CONTAINER_DLL_insert_tail (overlay->rl_head, overlay->rl_tail,
+                                        retry_entry);
+    }
+  }
+  overlay->ncompleted++;
+  if (overlay->ncompleted < overlay->nlinks)
+    return;
+  overlay_round_completed (tc);
+}
+
+
+/**
+ * Starts the bulk overlay connect operation of a link batch
+ *
+ * @param overlay the overlay topology context
+ * @param batch the batch
+ */
+static void
+start_overlay_batch (struct TopologyContextOverlay *overlay,
+                     struct OverlayBatch *batch)
+{
+  batch->op =
+      GNUNET_TESTBED_overlay_connect_bulk (overlay->op_cls,
+                                           &overlay_batch_progress, batch,
+                                           overlay->peers[batch->A],
+                                           batch->npeers, batch->peers);
+}
+
+
+/**
+ * Called when all the links (or link batches) of the current round have
+ * completed.  Retries the failed ones if we have retries left, otherwise
+ * calls the topology completion callback.
+ *
+ * @param tc the topology context
+ */
+static void
+overlay_round_completed (struct TopologyContext *tc)
+{
+  struct TopologyContextOverlay *overlay;
+  struct RetryListEntry *retry_entry;
+  struct OverlayLink *link;
+
+  overlay = &tc->u.overlay;
   if ((0 != overlay->retry_cnt) && (NULL != overlay->rl_head))
   {
     overlay->retry_cnt--;
@@ -379,11 +547,19 @@ overlay_link_completed (void *cls, struct GNUNET_TESTBED_Operation *op,
     overlay->nlinks = 0;
     while (NULL != (retry_entry = overlay->rl_head))
     {
-      link = retry_entry->link;
-      link->op =
-          GNUNET_TESTBED_overlay_connect (overlay->op_cls, &overlay_link_completed,
-                                          link, overlay->peers[link->A],
-                                          overlay->peers[link->B]);
+      if (NULL != retry_entry->batch)
+      {
+        start_overlay_batch (overlay, retry_entry->batch);
+      }
+      else
+      {
+        link = retry_entry->link;
+        link->op =
+            GNUNET_TESTBED_overlay_connect (overlay->op_cls,
+                                            &overlay_link_completed,
+                                            link, overlay->peers[link->A],
+                                            overlay->peers[link->B]);
+      }
       overlay->nlinks++;
       GNUNET_CONTAINER_DLL_remove (overlay->rl_head, overlay->rl_tail, retry_entry);
       GNUNET_free (retry_entry);
@@ -397,6 +573,72 @@ overlay_link_completed (void *cls, struct GNUNET_TESTBED_Operation *op,
 }
 
 
+/**
+ * Compares two overlay links by their peer A
+ *
+ * @param a the first link
+ * @param b the second link
+ * @return -1, 0 or 1 if the peer A of a is less than, equal to or greater than
+ *           that of b
+ */
+static int
+link_cmp_A (const void *a, const void *b)
+{
+  const struct OverlayLink *la = a;
+  const struct OverlayLink *lb = b;
+
+  if (la->A < lb->A)
+    return -1;
+  if (la->A > lb->A)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Groups the links of an overlay topology by their peer A into batches and
+ * starts a bulk overlay connect operation for each batch
+ *
+ * @param tc the topology context
+ */
+static void
+start_overlay_batches (struct TopologyContext *tc)
+{
+  struct TopologyContextOverlay *overlay;
+  struct OverlayBatch *batch;
+  unsigned int p;
+
+  overlay = &tc->u.overlay;
+  qsort (overlay->link_array, tc->link_array_size, sizeof (struct OverlayLink),
+         &link_cmp_A);
+  overlay->batch_peers = GNUNET_malloc (tc->link_array_size
+                                        * sizeof (struct GNUNET_TESTBED_Peer *));
+  overlay->nbatches = 0;
+  batch = NULL;
+  for (p = 0; p < tc->link_array_size; p++)
+  {
+    if ((NULL == batch) ||
+        (batch->A != overlay->link_array[p].A) ||
+        (batch->npeers == GNUNET_TESTBED_BULK_OVERLAY_CONNECT_MAX))
+    {
+      GNUNET_array_grow (overlay->batch_array, overlay->nbatches,
+                         overlay->nbatches + 1);
+      batch = &overlay->batch_array[overlay->nbatches - 1];
+      batch->tc = tc;
+      batch->A = overlay->link_array[p].A;
+      batch->peers = &overlay->batch_peers[p];
+    }
+    batch->peers[batch->npeers++] =
+        overlay->peers[overlay->link_array[p].B];
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG, "Establishing %u links in %u batches\n",
+       tc->link_array_size, overlay->nbatches);
+  overlay->nlinks = overlay->nbatches;
+  for (p = 0; p < overlay->nbatches; p++)
+    start_overlay_batch (overlay, &overlay->batch_array[p]);
+}
+
+
 
 /**
  * Function called when a overlay connect operation is ready
@@ -412,6 +654,11 @@ opstart_overlay_configure_topology (void *cls)
 
   GNUNET_assert (TOPOLOGYCONTEXT_TYPE_OVERLAY == tc->type);
   overlay = &tc->u.overlay;
+  if (GNUNET_YES == overlay->bulk)
+  {
+    start_overlay_batches (tc);
+    return;
+  }
   overlay->nlinks = tc->link_array_size;
   for (p = 0; p < tc->link_array_size; p++)
   {
@@ -451,6 +698,11 @@ oprelease_overlay_configure_topology (void *cls)
         GNUNET_TESTBED_operation_done (overlay->link_array[p].op);
     GNUNET_free (overlay->link_array);
   }
+  for (p = 0; p < overlay->nbatches; p++)
+    if (NULL != overlay->batch_array[p].op)
+      GNUNET_TESTBED_operation_done (overlay->batch_array[p].op);
+  GNUNET_array_grow (overlay->batch_array, overlay->nbatches, 0);
+  GNUNET_free_non_null (overlay->batch_peers);
   GNUNET_free (tc);
 }
 
@@ -1322,6 +1574,9 @@ GNUNET_TESTBED_overlay_configure_topology_va (void *op_cls,
     case GNUNET_TESTBED_TOPOLOGY_RETRY_CNT:
       overlay->retry_cnt =  va_arg (va, unsigned int);
       break;
+    case GNUNET_TESTBED_TOPOLOGY_BULK_CONNECT:
+      overlay->bulk = GNUNET_YES;
+      break;
     case GNUNET_TESTBED_TOPOLOGY_OPTION_END:
       break;
     default:
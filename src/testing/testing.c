@@ -1113,6 +1113,112 @@ GNUNET_TESTING_configuration_create (struct GNUNET_TESTING_System *system,
 }
 
 
+/**
+ * Hostkeys are written once into a read-only template directory of
+ * the system and then hardlinked into each peer's home, so that
+ * configuring many peers does not write the same keys over and over.
+ * Returns the name of the template file for the given key, creating
+ * it if necessary.
+ *
+ * @param system system the key belongs to
+ * @param key_number number of the hostkey
+ * @return name of the template file (to be freed by the caller),
+ *         NULL if the template could not be created
+ */
+static char *
+hostkey_template (struct GNUNET_TESTING_System *system,
+                  uint32_t key_number)
+{
+  struct GNUNET_DISK_FileHandle *fd;
+  char *filename;
+
+  GNUNET_asprintf (&filename, "%s/template/hostkeys/%u.key",
+                   system->tmppath, (unsigned int) key_number);
+  if (GNUNET_YES == GNUNET_DISK_file_test (filename))
+    return filename;
+  if (GNUNET_OK != GNUNET_DISK_directory_create_for_file (filename))
+  {
+    GNUNET_free (filename);
+    return NULL;
+  }
+  fd = GNUNET_DISK_file_open (filename,
+                              GNUNET_DISK_OPEN_CREATE | GNUNET_DISK_OPEN_WRITE,
+                              GNUNET_DISK_PERM_USER_READ);
+  if (NULL == fd)
+  {
+    GNUNET_free (filename);
+    return NULL;
+  }
+  if (GNUNET_TESTING_HOSTKEYFILESIZE !=
+      GNUNET_DISK_file_write (fd, system->hostkeys_data
+                              + (key_number * GNUNET_TESTING_HOSTKEYFILESIZE),
+                              GNUNET_TESTING_HOSTKEYFILESIZE))
+  {
+    GNUNET_DISK_file_close (fd);
+    (void) UNLINK (filename);
+    GNUNET_free (filename);
+    return NULL;
+  }
+  GNUNET_DISK_file_close (fd);
+  return filename;
+}
+
+
+/**
+ * Install the given hostkey as the private key file of a peer.  Uses
+ * a hardlink to the system's template if possible and writes a copy
+ * otherwise.
+ *
+ * @param system system the key belongs to
+ * @param key_number number of the hostkey
+ * @param hostkey_filename name of the peer's private key file
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error (errno is set)
+ */
+static int
+hostkey_install (struct GNUNET_TESTING_System *system,
+                 uint32_t key_number,
+                 const char *hostkey_filename)
+{
+  struct GNUNET_DISK_FileHandle *fd;
+#ifndef MINGW
+  char *template;
+#endif
+
+  (void) GNUNET_DISK_directory_create_for_file (hostkey_filename);
+  (void) UNLINK (hostkey_filename);
+#ifndef MINGW
+  if (NULL != (template = hostkey_template (system, key_number)))
+  {
+    if (0 == link (template, hostkey_filename))
+    {
+      GNUNET_free (template);
+      return GNUNET_OK;
+    }
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Failed to link `%s' to `%s', copying hostkey: %s\n",
+         template, hostkey_filename, STRERROR (errno));
+    GNUNET_free (template);
+  }
+#endif
+  fd = GNUNET_DISK_file_open (hostkey_filename,
+                              GNUNET_DISK_OPEN_CREATE | GNUNET_DISK_OPEN_WRITE,
+                              GNUNET_DISK_PERM_USER_READ
+                              | GNUNET_DISK_PERM_USER_WRITE);
+  if (NULL == fd)
+    return GNUNET_SYSERR;
+  if (GNUNET_TESTING_HOSTKEYFILESIZE !=
+      GNUNET_DISK_file_write (fd, system->hostkeys_data
+			      + (key_number * GNUNET_TESTING_HOSTKEYFILESIZE),
+			      GNUNET_TESTING_HOSTKEYFILESIZE))
+  {
+    GNUNET_DISK_file_close (fd);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_DISK_file_close (fd);
+  return GNUNET_OK;
+}
+
+
 /**
  * Configure a GNUnet peer.  GNUnet must be installed on the local
  * system and available in the PATH.
@@ -1134,7 +1240,6 @@ GNUNET_TESTING_peer_configure (struct GNUNET_TESTING_System *system,
 			       char **emsg)
 {
   struct GNUNET_TESTING_Peer *peer;
-  struct GNUNET_DISK_FileHandle *fd;
   char *hostkey_filename;
   char *config_filename;
   char *libexec_binary;
@@ -1194,31 +1299,17 @@ GNUNET_TESTING_peer_configure (struct GNUNET_TESTING_System *system,
                  GNUNET_CONFIGURATION_get_value_filename (cfg, "PEER",
 							  "PRIVATE_KEY",
 							  &hostkey_filename));
-  fd = GNUNET_DISK_file_open (hostkey_filename,
-                              GNUNET_DISK_OPEN_CREATE | GNUNET_DISK_OPEN_WRITE,
-                              GNUNET_DISK_PERM_USER_READ
-                              | GNUNET_DISK_PERM_USER_WRITE);
-  if (NULL == fd)
-  {
-    GNUNET_asprintf (&emsg_, _("Cannot open hostkey file `%s': %s\n"),
-                     hostkey_filename, STRERROR (errno));
-    GNUNET_free (hostkey_filename);
-    goto err_ret;
-  }
-  GNUNET_free (hostkey_filename);
-  if (GNUNET_TESTING_HOSTKEYFILESIZE !=
-      GNUNET_DISK_file_write (fd, system->hostkeys_data
-			      + (key_number * GNUNET_TESTING_HOSTKEYFILESIZE),
-			      GNUNET_TESTING_HOSTKEYFILESIZE))
+  if (GNUNET_OK != hostkey_install (system, key_number, hostkey_filename))
   {
     GNUNET_asprintf (&emsg_,
-		     _("Failed to write hostkey file for peer %u: %s\n"),
+		     _("Failed to write hostkey file `%s' for peer %u: %s\n"),
+                     hostkey_filename,
 		     (unsigned int) key_number,
 		     STRERROR (errno));
-    GNUNET_DISK_file_close (fd);
+    GNUNET_free (hostkey_filename);
     goto err_ret;
   }
-  GNUNET_DISK_file_close (fd);
+  GNUNET_free (hostkey_filename);
   ss_instances = GNUNET_malloc (sizeof (struct SharedServiceInstance *)
                                 * system->n_shared_services);
   for (cnt=0; cnt < system->n_shared_services; cnt++)
@@ -93,6 +93,38 @@ struct Peer
    */
   struct GNUNET_PeerIdentity pid;
 
+  /**
+   * Next peer with a HELLO, in the ring of HELLOs we advertise.
+   */
+  struct Peer *next_adv;
+
+  /**
+   * Previous peer with a HELLO, in the ring of HELLOs we advertise.
+   */
+  struct Peer *prev_adv;
+
+  /**
+   * Next peer in the DLL of connected peers.
+   */
+  struct Peer *next_conn;
+
+  /**
+   * Previous peer in the DLL of connected peers.
+   */
+  struct Peer *prev_conn;
+
+  /**
+   * For connected peers: the entry in the ring of HELLOs to consider
+   * next for advertising to this peer, NULL for the head of the ring.
+   */
+  struct Peer *adv_cursor;
+
+  /**
+   * Entry in #connect_heap while we consider connecting to this peer,
+   * NULL otherwise.
+   */
+  struct GNUNET_CONTAINER_HeapNode *connect_hn;
+
   /**
    * Our handle for the request to transmit HELLOs to this peer; NULL
    * if no such request is pending.
@@ -137,16 +169,6 @@ struct Peer
    */
   struct GNUNET_SCHEDULER_Task * hello_delay_task;
 
-  /**
-   * Task for issuing GNUNET_TRANSPORT_try_connect for this peer.
-   */
-  struct GNUNET_SCHEDULER_Task * attempt_connect_task;
-
-  /**
-   * ID of task we use to clear peers from the greylist.
-   */
-  struct GNUNET_SCHEDULER_Task * greylist_clean_task;
-
   /**
    * How often have we tried so far?
    */
@@ -214,9 +236,40 @@ static struct GNUNET_TRANSPORT_Blacklist *blacklist;
 static struct GNUNET_TIME_Absolute next_connect_attempt;
 
 /**
- * Task scheduled to try to add peers.
+ * Peers we consider connecting to, by the time of the next attempt
+ * (the later of their greylisting and back-off).
+ */
+static struct GNUNET_CONTAINER_Heap *connect_heap;
+
+/**
+ * Task to connect to the root of #connect_heap.
  */
-static struct GNUNET_SCHEDULER_Task * add_task;
+static struct GNUNET_SCHEDULER_Task * connect_task;
+
+/**
+ * Head of the ring of peers with a HELLO we can advertise.
+ */
+static struct Peer *adv_head;
+
+/**
+ * Tail of the ring of peers with a HELLO we can advertise.
+ */
+static struct Peer *adv_tail;
+
+/**
+ * Number of peers in the ring of HELLOs.
+ */
+static unsigned int adv_count;
+
+/**
+ * Head of the DLL of peers we are connected to.
+ */
+static struct Peer *connected_head;
+
+/**
+ * Tail of the DLL of peers we are connected to.
+ */
+static struct Peer *connected_tail;
 
 /**
  * Flag to disallow non-friend connections (pure F2F mode).
@@ -313,6 +366,38 @@ is_connection_allowed (struct Peer *peer)
 }
 
 
+/**
+ * Add a peer that now has a HELLO to the ring of HELLOs we advertise.
+ *
+ * @param peer peer with a HELLO
+ */
+static void
+adv_ring_add (struct Peer *peer)
+{
+  GNUNET_CONTAINER_MDLL_insert_tail (adv, adv_head, adv_tail, peer);
+  adv_count++;
+}
+
+
+/**
+ * Remove a peer from the ring of HELLOs we advertise, moving the
+ * cursors of the connected peers that point to it on to the next entry.
+ *
+ * @param peer peer whose HELLO is going away
+ */
+static void
+adv_ring_remove (struct Peer *peer)
+{
+  struct Peer *pos;
+
+  for (pos = connected_head; NULL != pos; pos = pos->next_conn)
+    if (pos->adv_cursor == peer)
+      pos->adv_cursor = peer->next_adv;
+  GNUNET_CONTAINER_MDLL_remove (adv, adv_head, adv_tail, peer);
+  adv_count--;
+}
+
+
 /**
  * Free all resources associated with the given peer.
  *
@@ -333,11 +418,15 @@ free_peer (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
     GNUNET_CORE_notify_transmit_ready_cancel (pos->hello_req);
   if (pos->hello_delay_task != NULL)
     GNUNET_SCHEDULER_cancel (pos->hello_delay_task);
-  if (pos->attempt_connect_task != NULL)
-    GNUNET_SCHEDULER_cancel (pos->attempt_connect_task);
-  if (pos->greylist_clean_task != NULL)
-    GNUNET_SCHEDULER_cancel (pos->greylist_clean_task);
-  GNUNET_free_non_null (pos->hello);
+  if (NULL != pos->connect_hn)
+    GNUNET_CONTAINER_heap_remove_node (pos->connect_hn);
+  if (GNUNET_YES == pos->is_connected)
+    GNUNET_CONTAINER_MDLL_remove (conn, connected_head, connected_tail, pos);
+  if (NULL != pos->hello)
+  {
+    adv_ring_remove (pos);
+    GNUNET_free (pos->hello);
+  }
   if (pos->filter != NULL)
     GNUNET_CONTAINER_bloomfilter_free (pos->filter);
   GNUNET_free (pos);
@@ -345,17 +434,6 @@ free_peer (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
 }
 
 
-/**
- * Discard peer entries for greylisted peers
- * where the greylisting has expired.
- *
- * @param cls 'struct Peer' to greylist
- * @param tc scheduler context
- */
-static void
-remove_from_greylist (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
-
-
 /**
  * Try to connect to the specified peer.
  *
@@ -366,15 +444,6 @@ attempt_connect (struct Peer *pos)
 {
   struct GNUNET_TIME_Relative rem;
 
-  if ((connection_count >= target_connection_count) &&
-      (friend_count >= minimum_friend_count))
-    return;
-  if (GNUNET_YES == pos->is_connected)
-    return;
-  if (GNUNET_OK != is_connection_allowed (pos))
-    return;
-  if (GNUNET_TIME_absolute_get_remaining (pos->greylisted_until).rel_value_us > 0)
-    return;
   if (GNUNET_YES == pos->is_friend)
     rem = GREYLIST_AFTER_ATTEMPT_FRIEND;
   else
@@ -395,10 +464,6 @@ attempt_connect (struct Peer *pos)
   pos->next_connect_attempt = GNUNET_TIME_absolute_min (pos->next_connect_attempt,
       GNUNET_TIME_absolute_add (GNUNET_TIME_absolute_get(), MIN_CONNECT_FREQUENCY_DELAY));
 
-  if (pos->greylist_clean_task != NULL)
-    GNUNET_SCHEDULER_cancel (pos->greylist_clean_task);
-  pos->greylist_clean_task =
-      GNUNET_SCHEDULER_add_delayed (rem, &remove_from_greylist, pos);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Asking  to connect to `%s'\n",
               GNUNET_i2s (&pos->pid));
   GNUNET_STATISTICS_update (stats,
@@ -410,88 +475,138 @@ attempt_connect (struct Peer *pos)
 
 
 /**
- * Try to connect to the specified peer.
+ * Do we have enough connections (including friends)?
  *
- * @param cls peer to connect to
+ * @return #GNUNET_YES if we should not try to connect to more peers
+ */
+static int
+have_enough_connections ()
+{
+  return ( (connection_count >= target_connection_count) &&
+           (friend_count >= minimum_friend_count) ) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Connect to the peers in #connect_heap whose time has come, at
+ * most one per #MAX_CONNECT_FREQUENCY_DELAY.
+ *
+ * @param cls NULL
  * @param tc scheduler context
  */
 static void
 do_attempt_connect (void *cls,
-		    const struct GNUNET_SCHEDULER_TaskContext *tc)
-{
-  struct Peer *pos = cls;
-  struct GNUNET_TIME_Relative delay;
+		    const struct GNUNET_SCHEDULER_TaskContext *tc);
 
-  pos->attempt_connect_task = NULL;
-  if (GNUNET_YES == pos->is_connected)
-    return;
 
-  /* Try next connection attempt, when:
-   * - topology allows the next transport connection attempt
-   * and
-   * - the next connection event for this peer is allowed
-   */
-  delay = GNUNET_TIME_relative_max (GNUNET_TIME_absolute_get_remaining (next_connect_attempt),
-      GNUNET_TIME_absolute_get_remaining (pos->next_connect_attempt));
+/**
+ * Make sure #do_attempt_connect() runs when the next peer in
+ * #connect_heap is due.
+ */
+static void
+schedule_connect_task ()
+{
+  struct Peer *pos;
+  GNUNET_CONTAINER_HeapCostType cost;
+  struct GNUNET_TIME_Absolute due;
 
-  if (delay.rel_value_us > 0)
+  if (NULL != connect_task)
   {
-    pos->attempt_connect_task = GNUNET_SCHEDULER_add_delayed (delay,
-							      &do_attempt_connect,
-							      pos);
-    return;
+    GNUNET_SCHEDULER_cancel (connect_task);
+    connect_task = NULL;
   }
-  next_connect_attempt = GNUNET_TIME_relative_to_absolute (MAX_CONNECT_FREQUENCY_DELAY);
-  attempt_connect (pos);
+  if ( (GNUNET_YES == have_enough_connections ()) ||
+       (GNUNET_NO == GNUNET_CONTAINER_heap_peek2 (connect_heap,
+                                                  (void **) &pos,
+                                                  &cost)) )
+    return;
+  due.abs_value_us = cost;
+  due = GNUNET_TIME_absolute_max (due, next_connect_attempt);
+  connect_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (due),
+                                               &do_attempt_connect,
+                                               NULL);
 }
 
 
 /**
- * Schedule a task to try to connect to the specified peer.
+ * Consider connecting to the specified peer once its greylisting
+ * and back-off allow it.
  *
  * @param pos peer to connect to
  */
 static void
 schedule_attempt_connect (struct Peer *pos)
 {
-  if (NULL != pos->attempt_connect_task)
+  struct GNUNET_TIME_Absolute due;
+
+  if ( (GNUNET_YES == pos->is_connected) ||
+       (NULL != pos->connect_hn) )
     return;
-  pos->attempt_connect_task = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (next_connect_attempt),
-							    &do_attempt_connect,
-							    pos);
+  due = GNUNET_TIME_absolute_max (pos->greylisted_until,
+                                  pos->next_connect_attempt);
+  pos->connect_hn = GNUNET_CONTAINER_heap_insert (connect_heap, pos,
+                                                  due.abs_value_us);
+  if (GNUNET_CONTAINER_heap_peek (connect_heap) == pos)
+    schedule_connect_task ();
 }
 
 
-/**
- * Discard peer entries for greylisted peers
- * where the greylisting has expired.
- *
- * @param cls 'struct Peer' to greylist
- * @param tc scheduler context
- */
 static void
-remove_from_greylist (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+do_attempt_connect (void *cls,
+		    const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct Peer *pos = cls;
-  struct GNUNET_TIME_Relative rem;
-
-  pos->greylist_clean_task = NULL;
-  rem = GNUNET_TIME_absolute_get_remaining (pos->greylisted_until);
-  if (0 == rem.rel_value_us)
+  struct Peer *pos;
+  GNUNET_CONTAINER_HeapCostType cost;
+
+  connect_task = NULL;
+  while ( (GNUNET_NO == have_enough_connections ()) &&
+          (GNUNET_YES == GNUNET_CONTAINER_heap_peek2 (connect_heap,
+                                                      (void **) &pos,
+                                                      &cost)) &&
+          (cost <= GNUNET_TIME_absolute_get ().abs_value_us) )
   {
+    GNUNET_CONTAINER_heap_remove_root (connect_heap);
+    pos->connect_hn = NULL;
+    if ( (GNUNET_NO == pos->is_friend) &&
+         (NULL == pos->hello) &&
+         (0 != pos->connect_attempts) )
+    {
+      /* greylisting expired and we have no HELLO, discard the entry */
+      free_peer (NULL, &pos->pid, pos);
+      continue;
+    }
+    if (GNUNET_OK != is_connection_allowed (pos))
+      continue; /* requeued by requeue_peers() once it is allowed */
+    if (0 != GNUNET_TIME_absolute_get_remaining (next_connect_attempt).rel_value_us)
+    {
+      /* not yet, transport would be too busy */
+      pos->connect_hn = GNUNET_CONTAINER_heap_insert (connect_heap, pos, cost);
+      break;
+    }
+    next_connect_attempt = GNUNET_TIME_relative_to_absolute (MAX_CONNECT_FREQUENCY_DELAY);
+    attempt_connect (pos);
+    /* retry after the greylisting expired */
     schedule_attempt_connect (pos);
   }
-  else
-  {
-    pos->greylist_clean_task =
-        GNUNET_SCHEDULER_add_delayed (rem, &remove_from_greylist, pos);
-  }
-  if ((GNUNET_NO == pos->is_friend) && (GNUNET_NO == pos->is_connected) &&
-      (NULL == pos->hello))
-  {
-    free_peer (NULL, &pos->pid, pos);
-    return;
-  }
+  schedule_connect_task ();
+}
+
+
+/**
+ * Consider connecting to a peer again that was not allowed before.
+ *
+ * @param cls NULL
+ * @param pid identity of a peer
+ * @param value `struct Peer *` for the peer
+ * @return #GNUNET_YES (continue to iterate)
+ */
+static int
+requeue_peers (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
+{
+  struct Peer *pos = value;
+
+  schedule_attempt_connect (pos);
+  return GNUNET_YES;
 }
 
 
@@ -517,6 +632,7 @@ make_peer (const struct GNUNET_PeerIdentity *peer,
   {
     ret->hello = GNUNET_malloc (GNUNET_HELLO_size (hello));
     memcpy (ret->hello, hello, GNUNET_HELLO_size (hello));
+    adv_ring_add (ret);
   }
   GNUNET_break (GNUNET_OK ==
                 GNUNET_CONTAINER_multipeermap_put (peers, peer,
@@ -566,68 +682,60 @@ hello_advertising_ready (void *cls, size_t size, void *buf);
 
 
 /**
- * Closure for 'find_advertisable_hello'.
- */
-struct FindAdvHelloContext
-{
-
-  /**
-   * Peer we want to advertise to.
-   */
-  struct Peer *peer;
-
-  /**
-   * Where to store the result (peer selected for advertising).
-   */
-  struct Peer *result;
-
-  /**
-   * Maximum HELLO size we can use right now.
-   */
-  size_t max_size;
-
-  struct GNUNET_TIME_Relative next_adv;
-};
-
-
-/**
- * Find a peer that would be reasonable for advertising.
+ * Find a peer that would be reasonable for advertising.  Continues
+ * the walk around the ring of HELLOs where the last one for @a pl
+ * stopped, so each HELLO is only considered about once per round.
+ * The cursor of @a pl is left on the result, so that a second call
+ * returns it again until it was added to its filter.
  *
- * @param cls closure
- * @param pid identity of a peer
- * @param value 'struct Peer*' for the peer we are considering
- * @return GNUNET_YES (continue iteration)
+ * @param pl peer we want to advertise to
+ * @param max_size maximum HELLO size we can use right now
+ * @param next_adv set to the time until the next filter expires
+ * @return peer selected for advertising, NULL for none
  */
-static int
-find_advertisable_hello (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
+static struct Peer *
+find_advertisable_hello (struct Peer *pl,
+                         size_t max_size,
+                         struct GNUNET_TIME_Relative *next_adv)
 {
-  struct FindAdvHelloContext *fah = cls;
-  struct Peer *pos = value;
+  struct Peer *pos;
   struct GNUNET_TIME_Relative rst_time;
   struct GNUNET_HashCode hc;
-  size_t hs;
-
-  if (pos == fah->peer)
-    return GNUNET_YES;
-  if (pos->hello == NULL)
-    return GNUNET_YES;
-  rst_time = GNUNET_TIME_absolute_get_remaining (pos->filter_expiration);
-  if (0 == rst_time.rel_value_us)
+  unsigned int i;
+
+  *next_adv = GNUNET_TIME_UNIT_FOREVER_REL;
+  GNUNET_CRYPTO_hash (&pl->pid, sizeof (struct GNUNET_PeerIdentity), &hc);
+  pos = pl->adv_cursor;
+  for (i = 0; i < adv_count; i++)
   {
-    /* time to discard... */
-    GNUNET_CONTAINER_bloomfilter_free (pos->filter);
-    setup_filter (pos);
+    if (NULL == pos)
+      pos = adv_head;
+    if (pos == pl)
+    {
+      pos = pos->next_adv;
+      continue;
+    }
+    rst_time = GNUNET_TIME_absolute_get_remaining (pos->filter_expiration);
+    if (0 == rst_time.rel_value_us)
+    {
+      /* time to discard... */
+      GNUNET_CONTAINER_bloomfilter_free (pos->filter);
+      setup_filter (pos);
+      rst_time = HELLO_ADVERTISEMENT_MIN_REPEAT_FREQUENCY;
+    }
+    *next_adv = GNUNET_TIME_relative_min (rst_time, *next_adv);
+    if ( (GNUNET_HELLO_size (pos->hello) <= max_size) &&
+         (GNUNET_NO ==
+          GNUNET_CONTAINER_bloomfilter_test (pos->filter,
+                                             &hc)) )
+    {
+      pl->adv_cursor = pos;
+      return pos;
+    }
+    pos = pos->next_adv;
   }
-  fah->next_adv = GNUNET_TIME_relative_min (rst_time, fah->next_adv);
-  hs = GNUNET_HELLO_size (pos->hello);
-  if (hs > fah->max_size)
-    return GNUNET_YES;
-  GNUNET_CRYPTO_hash (&fah->peer->pid, sizeof (struct GNUNET_PeerIdentity), &hc);
-  if (GNUNET_NO ==
-      GNUNET_CONTAINER_bloomfilter_test (pos->filter,
-                                         &hc))
-    fah->result = pos;
-  return GNUNET_YES;
+  pl->adv_cursor = pos;
+  return NULL;
 }
 
 
@@ -642,8 +750,9 @@ static void
 schedule_next_hello (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct Peer *pl = cls;
-  struct FindAdvHelloContext fah;
+  struct Peer *result;
   size_t next_want;
+  struct GNUNET_TIME_Relative next_adv;
   struct GNUNET_TIME_Relative delay;
 
   pl->hello_delay_task = NULL;
@@ -653,27 +762,31 @@ schedule_next_hello (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
   if (pl->hello_req != NULL)
     return;                     /* did not finish sending the previous one */
   /* find applicable HELLOs */
-  fah.peer = pl;
-  fah.result = NULL;
-  fah.max_size = GNUNET_SERVER_MAX_MESSAGE_SIZE - 1;
-  fah.next_adv = GNUNET_TIME_UNIT_FOREVER_REL;
-  GNUNET_CONTAINER_multipeermap_iterate (peers, &find_advertisable_hello, &fah);
-  pl->hello_delay_task =
-      GNUNET_SCHEDULER_add_delayed (fah.next_adv, &schedule_next_hello, pl);
-  if (fah.result == NULL)
+  result = find_advertisable_hello (pl,
+                                    GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
+                                    &next_adv);
+  if (NULL == result)
+  {
+    /* nothing to send until a filter expires (or a new HELLO arrives) */
+    pl->hello_delay_task =
+        GNUNET_SCHEDULER_add_delayed (next_adv, &schedule_next_hello, pl);
     return;
-  next_want = GNUNET_HELLO_size (fah.result->hello);
+  }
   delay = GNUNET_TIME_absolute_get_remaining (pl->next_hello_allowed);
-  if (0 == delay.rel_value_us)
+  if (0 != delay.rel_value_us)
   {
-    /* now! */
-    pl->hello_req =
-        GNUNET_CORE_notify_transmit_ready (handle, GNUNET_YES,
-                                           GNUNET_CORE_PRIO_BEST_EFFORT,
-                                           GNUNET_CONSTANTS_SERVICE_TIMEOUT,
-                                           &pl->pid, next_want,
-                                           &hello_advertising_ready, pl);
+    pl->hello_delay_task =
+        GNUNET_SCHEDULER_add_delayed (delay, &schedule_next_hello, pl);
+    return;
   }
+  /* now! */
+  next_want = GNUNET_HELLO_size (result->hello);
+  pl->hello_req =
+      GNUNET_CORE_notify_transmit_ready (handle, GNUNET_YES,
+                                         GNUNET_CORE_PRIO_BEST_EFFORT,
+                                         GNUNET_CONSTANTS_SERVICE_TIMEOUT,
+                                         &pl->pid, next_want,
+                                         &hello_advertising_ready, pl);
 }
 
 
@@ -682,21 +795,11 @@ schedule_next_hello (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
  * and recalculate when we should send HELLOs to it based
  * on our current state (something changed!).
  *
- * @param cls closure, 'struct Peer' to skip, or NULL
- * @param pid identity of a peer
- * @param value 'struct Peer*' for the peer
- * @return GNUNET_YES (always)
+ * @param peer connected peer to reschedule
  */
-static int
-reschedule_hellos (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
+static void
+reschedule_hellos (struct Peer *peer)
 {
-  struct Peer *peer = value;
-  struct Peer *skip = cls;
-
-  if (skip == peer)
-    return GNUNET_YES;
-  if (!peer->is_connected)
-    return GNUNET_YES;
   if (peer->hello_req != NULL)
   {
     GNUNET_CORE_notify_transmit_ready_cancel (peer->hello_req);
@@ -709,7 +812,6 @@ reschedule_hellos (void *cls, const struct GNUNET_PeerIdentity * pid, void *valu
   }
   peer->hello_delay_task =
       GNUNET_SCHEDULER_add_now (&schedule_next_hello, peer);
-  return GNUNET_YES;
 }
 
 
@@ -744,52 +846,31 @@ connect_notify (void *cls, const struct GNUNET_PeerIdentity *peer)
     GNUNET_assert (GNUNET_NO == pos->is_connected);
     pos->greylisted_until.abs_value_us = 0;        /* remove greylisting */
   }
+  if (NULL != pos->connect_hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (pos->connect_hn);
+    pos->connect_hn = NULL;
+  }
   pos->is_connected = GNUNET_YES;
+  pos->adv_cursor = NULL;
+  GNUNET_CONTAINER_MDLL_insert (conn, connected_head, connected_tail, pos);
   pos->connect_attempts = 0;    /* re-set back-off factor */
   pos->next_connect_attempt = GNUNET_TIME_absolute_get(); /* re-set back-off factor */
   if (pos->is_friend)
   {
     if ((friend_count == minimum_friend_count - 1) &&
         (GNUNET_YES != friends_only))
+    {
       whitelist_peers ();
+      /* non-friends are allowed now, consider them again */
+      GNUNET_CONTAINER_multipeermap_iterate (peers, &requeue_peers, NULL);
+    }
     friend_count++;
     GNUNET_STATISTICS_set (stats, gettext_noop ("# friends connected"),
                            friend_count, GNUNET_NO);
   }
-  reschedule_hellos (NULL, peer, pos);
-}
-
-
-/**
- * Try to add more peers to our connection set.
- *
- * @param cls closure, not used
- * @param pid identity of a peer
- * @param value 'struct Peer*' for the peer
- * @return GNUNET_YES (continue to iterate)
- */
-static int
-try_add_peers (void *cls, const struct GNUNET_PeerIdentity * pid, void *value)
-{
-  struct Peer *pos = value;
-
-  schedule_attempt_connect (pos);
-  return GNUNET_YES;
-}
-
-
-/**
- * Add peers and schedule connection attempt
- *
- * @param cls unused, NULL
- * @param tc scheduler context
- */
-static void
-add_peer_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
-{
-  add_task = NULL;
-
-  GNUNET_CONTAINER_multipeermap_iterate (peers, &try_add_peers, NULL);
+  reschedule_hellos (pos);
+  schedule_connect_task ();
 }
 
 
@@ -821,6 +902,8 @@ disconnect_notify (void *cls, const struct GNUNET_PeerIdentity *peer)
     return;
   }
   pos->is_connected = GNUNET_NO;
+  GNUNET_CONTAINER_MDLL_remove (conn, connected_head, connected_tail, pos);
+  pos->adv_cursor = NULL;
   connection_count--;
   if (NULL != pos->hello_req)
   {
@@ -840,10 +923,8 @@ disconnect_notify (void *cls, const struct GNUNET_PeerIdentity *peer)
     GNUNET_STATISTICS_set (stats, gettext_noop ("# friends connected"),
                            friend_count, GNUNET_NO);
   }
-  if (((connection_count < target_connection_count) ||
-       (friend_count < minimum_friend_count)) &&
-      (NULL == add_task))
-    add_task = GNUNET_SCHEDULER_add_now (&add_peer_task, NULL);
+  schedule_attempt_connect (pos);
+  schedule_connect_task ();
   if ((friend_count < minimum_friend_count) && (blacklist == NULL))
     blacklist = GNUNET_TRANSPORT_blacklist (cfg, &blacklist_check, NULL);
 }
@@ -882,6 +963,7 @@ consider_for_advertising (const struct GNUNET_HELLO_Message *hello)
   struct GNUNET_TIME_Absolute dt;
   struct GNUNET_HELLO_Message *nh;
   struct Peer *peer;
+  struct Peer *pos;
   uint16_t size;
 
   if (GNUNET_OK != GNUNET_HELLO_get_id (hello, &pid))
@@ -921,13 +1003,16 @@ consider_for_advertising (const struct GNUNET_HELLO_Message *hello)
     size = GNUNET_HELLO_size (hello);
     peer->hello = GNUNET_malloc (size);
     memcpy (peer->hello, hello, size);
+    adv_ring_add (peer);
   }
   if (peer->filter != NULL)
     GNUNET_CONTAINER_bloomfilter_free (peer->filter);
   setup_filter (peer);
   /* since we have a new HELLO to pick from, re-schedule all
    * HELLO requests that are not bound by the HELLO send rate! */
-  GNUNET_CONTAINER_multipeermap_iterate (peers, &reschedule_hellos, peer);
+  for (pos = connected_head; NULL != pos; pos = pos->next_conn)
+    if (pos != peer)
+      reschedule_hellos (pos);
 }
 
 
@@ -964,8 +1049,12 @@ process_peer (void *cls, const struct GNUNET_PeerIdentity *peer,
     pos = GNUNET_CONTAINER_multipeermap_get (peers, peer);
     if (NULL != pos)
     {
-      GNUNET_free_non_null (pos->hello);
-      pos->hello = NULL;
+      if (NULL != pos->hello)
+      {
+        adv_ring_remove (pos);
+        GNUNET_free (pos->hello);
+        pos->hello = NULL;
+      }
       if (pos->filter != NULL)
       {
         GNUNET_CONTAINER_bloomfilter_free (pos->filter);
@@ -991,13 +1080,12 @@ process_peer (void *cls, const struct GNUNET_PeerIdentity *peer,
     return;
   }
   if (GNUNET_TIME_absolute_get_remaining (pos->greylisted_until).rel_value_us > 0)
-  {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Already tried peer `%s' recently\n",
                 GNUNET_i2s (peer));
-    return;                     /* peer still greylisted */
-  }
-  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Considering connecting to peer `%s'\n",
-              GNUNET_i2s (peer));
+  else
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Considering connecting to peer `%s'\n",
+                GNUNET_i2s (peer));
+  /* queued until its greylisting expires */
   schedule_attempt_connect (pos);
 }
 
@@ -1152,26 +1240,25 @@ static size_t
 hello_advertising_ready (void *cls, size_t size, void *buf)
 {
   struct Peer *pl = cls;
-  struct FindAdvHelloContext fah;
+  struct Peer *result;
+  struct GNUNET_TIME_Relative next_adv;
   size_t want;
   struct GNUNET_HashCode hc;
 
   pl->hello_req = NULL;
   GNUNET_assert (GNUNET_YES == pl->is_connected);
   /* find applicable HELLOs */
-  fah.peer = pl;
-  fah.result = NULL;
-  fah.max_size = size;
-  fah.next_adv = GNUNET_TIME_UNIT_FOREVER_REL;
-  GNUNET_CONTAINER_multipeermap_iterate (peers, &find_advertisable_hello, &fah);
+  result = NULL;
+  if (NULL != buf)
+    result = find_advertisable_hello (pl, size, &next_adv);
   want = 0;
-  if (fah.result != NULL)
+  if (result != NULL)
   {
-    want = GNUNET_HELLO_size (fah.result->hello);
+    want = GNUNET_HELLO_size (result->hello);
     GNUNET_assert (want <= size);
-    memcpy (buf, fah.result->hello, want);
+    memcpy (buf, result->hello, want);
     GNUNET_CRYPTO_hash (&pl->pid, sizeof (struct GNUNET_PeerIdentity), &hc);
-    GNUNET_CONTAINER_bloomfilter_add (fah.result->filter, &hc);
+    GNUNET_CONTAINER_bloomfilter_add (result->filter, &hc);
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG, "Sending `%s' with %u bytes", "HELLO",
                 (unsigned int) want);
     GNUNET_STATISTICS_update (stats,
@@ -1211,14 +1298,16 @@ cleaning_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     handle = NULL;
   }
   whitelist_peers ();
-  if (NULL != add_task)
+  if (NULL != connect_task)
   {
-    GNUNET_SCHEDULER_cancel (add_task);
-    add_task = NULL;
+    GNUNET_SCHEDULER_cancel (connect_task);
+    connect_task = NULL;
   }
   GNUNET_CONTAINER_multipeermap_iterate (peers, &free_peer, NULL);
   GNUNET_CONTAINER_multipeermap_destroy (peers);
   peers = NULL;
+  GNUNET_CONTAINER_heap_destroy (connect_heap);
+  connect_heap = NULL;
   if (stats != NULL)
   {
     GNUNET_STATISTICS_destroy (stats, GNUNET_NO);
@@ -1262,6 +1351,7 @@ run (void *cls,
     opt = 16;
   target_connection_count = (unsigned int) opt;
   peers = GNUNET_CONTAINER_multipeermap_create (target_connection_count * 2, GNUNET_NO);
+  connect_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
 
   if ((friends_only == GNUNET_YES) || (minimum_friend_count > 0))
     read_friends_file (cfg);
@@ -61,6 +61,17 @@
  */
 #define MAXLINE 4096
 
+/**
+ * Maximum number of received frames we pass to STDOUT with a
+ * single write.
+ */
+#define STDOUT_BATCH_FRAMES 16
+
+/**
+ * Space we reserve in the STDOUT buffer for each received frame.
+ */
+#define FRAME_SLOT_SIZE (MAXLINE * 2)
+
 
 /**
  * Maximum number of loops without inquiring for new devices.
@@ -158,10 +169,10 @@ struct SendBuffer
   size_t pos;
 
   /**
-   * Buffered data; twice the maximum allowed message size as we add some
-   * headers.
+   * Buffered data; twice the maximum allowed message size (as we add
+   * some headers) per frame, for up to #STDOUT_BATCH_FRAMES frames.
    */
-  char buf[MAXLINE * 2];
+  char buf[FRAME_SLOT_SIZE * STDOUT_BATCH_FRAMES];
 };
 
 #ifdef LINUX
@@ -1790,10 +1801,14 @@ main (int argc, char *argv[])
         maxfd = MAX (maxfd, dev.fd_rfcomm);
       }
 
-      for (i = 0; i < crt_rfds; i++)  // it can receive messages from multiple devices
+      /* only read from the devices if there is room for another frame */
+      if (write_std.size + FRAME_SLOT_SIZE <= sizeof (write_std.buf))
       {
-        FD_SET (rfds_list[i], &rfds);
-        maxfd = MAX (maxfd, rfds_list[i]);
+        for (i = 0; i < crt_rfds; i++)  // it can receive messages from multiple devices
+        {
+          FD_SET (rfds_list[i], &rfds);
+          maxfd = MAX (maxfd, rfds_list[i]);
+        }
       }
       FD_ZERO (&wfds);
       if (0 < write_std.size)
@@ -1962,7 +1977,7 @@ main (int argc, char *argv[])
           if (FD_ISSET (sendsocket , &wfds))
           {
             ssize_t ret = write (sendsocket,
-                                 write_pout.buf + write_std.pos,
+                                 write_pout.buf + write_pout.pos,
                                  write_pout.size - write_pout.pos);
             if (0 > ret) //FIXME should I first check the error type?
             {
@@ -1978,7 +1993,7 @@ main (int argc, char *argv[])
                 }
               }
               /* Remove the message */
-              memset (&write_pout.buf + write_std.pos, 0, (write_pout.size - write_pout.pos));
+              memset (write_pout.buf + write_pout.pos, 0, (write_pout.size - write_pout.pos));
               write_pout.pos = 0 ;
               write_pout.size = 0;
             }
@@ -2063,11 +2078,17 @@ main (int argc, char *argv[])
             {
               struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *rrm;
               ssize_t ret;
+              size_t msize;
+
+              /* frames from several devices are batched into 'write_std';
+                 leave the data in the socket if there is no room left */
+              if (write_std.size + FRAME_SLOT_SIZE > sizeof (write_std.buf))
+                continue;
               fprintf (stderr, "LOG : %s reads something from the socket\n", dev.iface);//FIXME : debugging message
-              rrm = (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *) write_std.buf;
+              rrm = (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *) &write_std.buf[write_std.size];
               ret =
                   read_from_the_socket ((void *)&i, (unsigned char *) &rrm->frame,
-                              sizeof (write_std.buf)
+                              FRAME_SLOT_SIZE
                   - sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
                   + sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame),
                   rrm);
@@ -2094,11 +2115,12 @@ main (int argc, char *argv[])
               }
               if ((0 < ret) && (0 == mac_test (&rrm->frame, &dev)))
               {
-                write_std.size = ret
+                msize = ret
             + sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
             - sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame);
-                rrm->header.size = htons (write_std.size);
+                rrm->header.size = htons (msize);
                 rrm->header.type = htons (GNUNET_MESSAGE_TYPE_WLAN_DATA_FROM_HELPER);
+                write_std.size += msize;
               }
             }
           }
@@ -2445,7 +2467,7 @@ main (int argc, char *argv[])
             fprintf (stderr, "LOG: reading something from the socket\n");//FIXME : debugging message
             rrm = (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *) write_std.buf;
             ret = read_from_the_socket (rfds_list[i], (unsigned char *) &rrm->frame,
-                              sizeof (write_std.buf)
+                              FRAME_SLOT_SIZE
                   - sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
                   + sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame),
                   rrm);
@@ -175,6 +175,17 @@
  */
 #define MAXLINE 4096
 
+/**
+ * Maximum number of received frames we pass to STDOUT with a
+ * single write.
+ */
+#define STDOUT_BATCH_FRAMES 16
+
+/**
+ * Space we reserve in the STDOUT buffer for each received frame.
+ */
+#define FRAME_SLOT_SIZE (MAXLINE * 2)
+
 
 
 /* ********* structure of messages of type ARPHRD_IEEE80211_PRISM *********** */
@@ -754,10 +765,10 @@ struct SendBuffer
   size_t pos;
 
   /**
-   * Buffered data; twice the maximum allowed message size as we add some
-   * headers.
+   * Buffered data; twice the maximum allowed message size (as we add
+   * some headers) per frame, for up to #STDOUT_BATCH_FRAMES frames.
    */
-  char buf[MAXLINE * 2];
+  char buf[FRAME_SLOT_SIZE * STDOUT_BATCH_FRAMES];
 };
 
 
@@ -1428,7 +1439,8 @@ linux_get_channel (const struct HardwareInfos *dev)
  *            followed by the actual payload
  * @param buf_size size of the buffer
  * @param ri where to write radiotap_rx info
- * @return number of bytes written to 'buf'
+ * @return number of bytes written to 'buf', 0 if the frame was
+ *         invalid or no frame was available (errno is EAGAIN), -1 on error
  */
 static ssize_t
 linux_read (struct HardwareInfos *dev,
@@ -1443,14 +1455,20 @@ linux_read (struct HardwareInfos *dev,
   int got_channel = 0;
   int fcs_removed = 0;
 
-  caplen = read (dev->fd_raw, tmpbuf, buf_size);
+  /* non-blocking, so that the caller can drain all pending frames */
+  caplen = recv (dev->fd_raw, tmpbuf, buf_size, MSG_DONTWAIT);
   if (0 > caplen)
   {
-    if (EAGAIN == errno)
+    if ( (EAGAIN == errno) ||
+         (EWOULDBLOCK == errno) )
+    {
+      errno = EAGAIN;
       return 0;
+    }
     fprintf (stderr, "Failed to read from RAW socket: %s\n", strerror (errno));
     return -1;
   }
+  errno = 0;
 
   memset (ri, 0, sizeof (*ri));
   switch (dev->arptype_in)
@@ -2030,7 +2048,7 @@ main (int argc, char *argv[])
       FD_SET (STDIN_FILENO, &rfds);
       maxfd = MAX (maxfd, STDIN_FILENO);
     }
-    if (0 == write_std.size)
+    if (write_std.size + FRAME_SLOT_SIZE <= sizeof (write_std.buf))
     {
       FD_SET (dev.fd_raw, &rfds);
       maxfd = MAX (maxfd, dev.fd_raw);
@@ -2076,7 +2094,7 @@ main (int argc, char *argv[])
     if (FD_ISSET (dev.fd_raw, &wfds))
     {
       ssize_t ret =
-	write (dev.fd_raw, write_pout.buf + write_std.pos,
+	write (dev.fd_raw, write_pout.buf + write_pout.pos,
 	       write_pout.size - write_pout.pos);
       if (0 > ret)
       {
@@ -2121,27 +2139,44 @@ main (int argc, char *argv[])
     {
       struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *rrm;
       ssize_t ret;
-
-      rrm = (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *) write_std.buf;
-      ret =
+      size_t msize;
+      unsigned int reads;
+
+      /* drain pending frames (as long as we have room), so that a
+         burst reaches the plugin with a single write to STDOUT */
+      ret = 0;
+      for (reads = 0;
+           (reads < STDOUT_BATCH_FRAMES) &&
+           (write_std.size + FRAME_SLOT_SIZE <= sizeof (write_std.buf));
+           reads++)
+      {
+        rrm = (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage *) &write_std.buf[write_std.size];
+        ret =
           linux_read (&dev, (unsigned char *) &rrm->frame,
-                      sizeof (write_std.buf)
-		      - sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
-		      + sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame),
-		      rrm);
+                      FRAME_SLOT_SIZE
+                      - sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
+                      + sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame),
+                      rrm);
+        if (0 > ret)
+          break;
+        if ( (0 == ret) &&
+             (EAGAIN == errno) )
+          break;
+        if ((0 < ret) && (0 == mac_test (&rrm->frame, &dev)))
+        {
+          msize = ret
+            + sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
+            - sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame);
+          rrm->header.size = htons (msize);
+          rrm->header.type = htons (GNUNET_MESSAGE_TYPE_WLAN_DATA_FROM_HELPER);
+          write_std.size += msize;
+        }
+      }
       if (0 > ret)
       {
         fprintf (stderr, "Read error from raw socket: %s\n", strerror (errno));
         break;
       }
-      if ((0 < ret) && (0 == mac_test (&rrm->frame, &dev)))
-      {
-        write_std.size = ret
-	  + sizeof (struct GNUNET_TRANSPORT_WLAN_RadiotapReceiveMessage)
-	  - sizeof (struct GNUNET_TRANSPORT_WLAN_Ieee80211Frame);
-        rrm->header.size = htons (write_std.size);
-        rrm->header.type = htons (GNUNET_MESSAGE_TYPE_WLAN_DATA_FROM_HELPER);
-      }
     }
   }
   /* Error handling, try to clean up a bit at least */
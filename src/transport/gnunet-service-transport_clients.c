@@ -1536,6 +1536,9 @@ GST_clients_start (struct GNUNET_SERVER_Handle *server)
     {&GST_manipulation_set_metric, NULL,
      GNUNET_MESSAGE_TYPE_TRANSPORT_TRAFFIC_METRIC,
      sizeof (struct TrafficMetricMessage) },
+    {&GST_manipulation_set_emulation, NULL,
+     GNUNET_MESSAGE_TYPE_TRANSPORT_TRAFFIC_EMULATION,
+     sizeof (struct TrafficEmulationMessage) },
     {&clients_handle_monitor_plugins, NULL,
      GNUNET_MESSAGE_TYPE_TRANSPORT_MONITOR_PLUGIN_START,
      sizeof (struct GNUNET_MessageHeader) },
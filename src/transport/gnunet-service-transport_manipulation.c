@@ -36,29 +36,25 @@
 
 
 /**
- * Struct containing information about manipulations to a specific peer
+ * Emulated link, either to a specific peer or the default for
+ * all peers without specific settings.
  */
-struct TM_Peer
+struct TM_Link
 {
   /**
-   * Peer ID
+   * Link characteristics to emulate.
    */
-  struct GNUNET_PeerIdentity peer;
+  struct GNUNET_TRANSPORT_EmulationParameters ep;
 
   /**
-   * How long to delay incoming messages for this peer.
+   * Until when is the outbound bandwidth of the link occupied?
    */
-  struct GNUNET_TIME_Relative delay_in;
+  struct GNUNET_TIME_Absolute busy_out;
 
   /**
-   * How long to delay outgoing messages for this peer.
+   * Until when is the inbound bandwidth of the link occupied?
    */
-  struct GNUNET_TIME_Relative delay_out;
-
-  /**
-   * Manipulated properties to use for this peer.
-   */
-  struct GNUNET_ATS_Properties properties;
+  struct GNUNET_TIME_Absolute busy_in;
 
   /**
    * Task to schedule delayed sendding
@@ -66,7 +62,7 @@ struct TM_Peer
   struct GNUNET_SCHEDULER_Task *send_delay_task;
 
   /**
-   * Send queue DLL head
+   * Send queue DLL head, sorted by `sent_at`
    */
   struct DelayQueueEntry *send_head;
 
@@ -77,6 +73,28 @@ struct TM_Peer
 };
 
 
+/**
+ * Struct containing information about manipulations to a specific peer
+ */
+struct TM_Peer
+{
+  /**
+   * Peer ID
+   */
+  struct GNUNET_PeerIdentity peer;
+
+  /**
+   * Manipulated properties to use for this peer.
+   */
+  struct GNUNET_ATS_Properties properties;
+
+  /**
+   * Emulated link to this peer.
+   */
+  struct TM_Link link;
+};
+
+
 /**
  * Entry in the delay queue for an outbound delayed message
  */
@@ -93,12 +111,10 @@ struct DelayQueueEntry
   struct DelayQueueEntry *next;
 
   /**
-   * Peer this entry is belonging to if (NULL == tmp): enqueued in
-   * generic DLL and scheduled by generic_send_delay_task else:
-   * enqueued in tmp->send_head and tmp->send_tail and scheduled by
-   * tmp->send_delay_task
+   * Link this entry is queued on; either the link of a `struct
+   * TM_Peer` or #generic_link.
    */
-  struct TM_Peer *tmp;
+  struct TM_Link *link;
 
   /**
    * Peer ID
@@ -136,35 +152,109 @@ struct DelayQueueEntry
   void *cont_cls;
 };
 
+
+/**
+ * Change to the default link at some point of the timeline.
+ */
+struct TimelineEvent
+{
+  /**
+   * When to apply the change, relative to the start of the service.
+   */
+  struct GNUNET_TIME_Relative offset;
+
+  /**
+   * Emulation option to change (see #apply_option()).
+   */
+  char *option;
+
+  /**
+   * New value of the option.
+   */
+  char *value;
+};
+
+
 /**
  * Hashmap contain all peers currently manipulated
  */
 static struct GNUNET_CONTAINER_MultiPeerMap *peers;
 
 /**
- * Inbound delay to apply to all peers.
+ * Link emulated for all peers without specific settings.
  */
-static struct GNUNET_TIME_Relative delay_in;
+static struct TM_Link generic_link;
 
 /**
- * Outbound delay to apply to all peers.
+ * Changes to #generic_link loaded from MANIPULATE_TIMELINE,
+ * sorted by offset.
  */
-static struct GNUNET_TIME_Relative delay_out;
+static struct TimelineEvent *timeline;
 
 /**
- * DLL head for delayed messages based on general delay
+ * Length of the #timeline.
  */
-static struct DelayQueueEntry *generic_dqe_head;
+static unsigned int timeline_len;
 
 /**
- * DLL tail for delayed messages based on general delay
+ * Next event of the #timeline to apply.
  */
-static struct DelayQueueEntry *generic_dqe_tail;
+static unsigned int timeline_pos;
 
 /**
- * Task to schedule delayed sending based on general delay
+ * When did the #timeline start?
+ */
+static struct GNUNET_TIME_Absolute timeline_start;
+
+/**
+ * Task applying the next #timeline event.
+ */
+static struct GNUNET_SCHEDULER_Task *timeline_task;
+
+
+/**
+ * Get the link emulated for a peer.
+ *
+ * @param peer the peer
+ * @return the link of the peer, or #generic_link
  */
-static struct GNUNET_SCHEDULER_Task *generic_send_delay_task;
+static struct TM_Link *
+get_link (const struct GNUNET_PeerIdentity *peer)
+{
+  struct TM_Peer *tmp;
+
+  tmp = GNUNET_CONTAINER_multipeermap_get (peers,
+                                           peer);
+  if (NULL == tmp)
+    return &generic_link;
+  return &tmp->link;
+}
+
+
+/**
+ * Get the manipulation information about a peer, creating
+ * it if necessary.
+ *
+ * @param peer the peer
+ * @return the information about @a peer
+ */
+static struct TM_Peer *
+get_tm_peer (const struct GNUNET_PeerIdentity *peer)
+{
+  struct TM_Peer *tmp;
+
+  tmp = GNUNET_CONTAINER_multipeermap_get (peers,
+                                           peer);
+  if (NULL != tmp)
+    return tmp;
+  tmp = GNUNET_new (struct TM_Peer);
+  tmp->peer = *peer;
+  GNUNET_CONTAINER_multipeermap_put (peers,
+                                     peer,
+                                     tmp,
+                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
+  return tmp;
+}
 
 
 /**
@@ -190,8 +280,8 @@ GST_manipulation_set_metric (void *cls,
   {
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Received traffic metrics for all peers\n");
-    delay_in = GNUNET_TIME_relative_ntoh (tm->delay_in);
-    delay_out = GNUNET_TIME_relative_ntoh (tm->delay_out);
+    generic_link.ep.delay_in = GNUNET_TIME_relative_ntoh (tm->delay_in);
+    generic_link.ep.delay_out = GNUNET_TIME_relative_ntoh (tm->delay_out);
     GNUNET_SERVER_receive_done (client,
                                 GNUNET_OK);
     return;
@@ -199,89 +289,233 @@ GST_manipulation_set_metric (void *cls,
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "Received traffic metrics for peer `%s'\n",
               GNUNET_i2s(&tm->peer));
-  if (NULL ==
-      (tmp = GNUNET_CONTAINER_multipeermap_get (peers,
-                                                &tm->peer)))
-  {
-    tmp = GNUNET_new (struct TM_Peer);
-    tmp->peer = tm->peer;
-    GNUNET_CONTAINER_multipeermap_put (peers,
-                                       &tm->peer,
-                                       tmp,
-                                       GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST);
-  }
+  tmp = get_tm_peer (&tm->peer);
   GNUNET_ATS_properties_ntoh (&tmp->properties,
                               &tm->properties);
-  tmp->delay_in = GNUNET_TIME_relative_ntoh (tm->delay_in);
-  tmp->delay_out = GNUNET_TIME_relative_ntoh (tm->delay_out);
+  tmp->link.ep.delay_in = GNUNET_TIME_relative_ntoh (tm->delay_in);
+  tmp->link.ep.delay_out = GNUNET_TIME_relative_ntoh (tm->delay_out);
   GNUNET_SERVER_receive_done (client,
                               GNUNET_OK);
 }
 
 
+/**
+ * Set link characteristics to emulate
+ *
+ * @param cls closure
+ * @param client client sending message
+ * @param message containing information
+ */
+void
+GST_manipulation_set_emulation (void *cls,
+                                struct GNUNET_SERVER_Client *client,
+                                const struct GNUNET_MessageHeader *message)
+{
+  const struct TrafficEmulationMessage *te;
+  static struct GNUNET_PeerIdentity zero;
+  struct GNUNET_TRANSPORT_EmulationParameters *ep;
+
+  te = (const struct TrafficEmulationMessage *) message;
+  if (0 == memcmp (&te->peer,
+                   &zero,
+                   sizeof(struct GNUNET_PeerIdentity)))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Received link emulation for all peers\n");
+    ep = &generic_link.ep;
+  }
+  else
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Received link emulation for peer `%s'\n",
+                GNUNET_i2s (&te->peer));
+    ep = &get_tm_peer (&te->peer)->link.ep;
+  }
+  ep->delay_in = GNUNET_TIME_relative_ntoh (te->delay_in);
+  ep->delay_out = GNUNET_TIME_relative_ntoh (te->delay_out);
+  ep->jitter_in = GNUNET_TIME_relative_ntoh (te->jitter_in);
+  ep->jitter_out = GNUNET_TIME_relative_ntoh (te->jitter_out);
+  ep->bandwidth_in = ntohl (te->bandwidth_in);
+  ep->bandwidth_out = ntohl (te->bandwidth_out);
+  ep->loss_in = GNUNET_MIN (ntohl (te->loss_in), 1000000);
+  ep->loss_out = GNUNET_MIN (ntohl (te->loss_out), 1000000);
+  ep->reorder = (GNUNET_YES == ntohl (te->reorder)) ? GNUNET_YES : GNUNET_NO;
+  GNUNET_SERVER_receive_done (client,
+                              GNUNET_OK);
+}
+
+
+/**
+ * Draw the delay of a message crossing an emulated link.
+ *
+ * @param delay fixed delay of the link
+ * @param jitter maximum deviation from @a delay
+ * @return delay uniformly distributed in [delay - jitter, delay + jitter]
+ */
+static struct GNUNET_TIME_Relative
+draw_delay (struct GNUNET_TIME_Relative delay,
+            struct GNUNET_TIME_Relative jitter)
+{
+  uint64_t off;
+
+  if (0 == jitter.rel_value_us)
+    return delay;
+  off = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                  2 * jitter.rel_value_us + 1);
+  if (delay.rel_value_us + off < jitter.rel_value_us)
+    return GNUNET_TIME_UNIT_ZERO;
+  delay.rel_value_us += off - jitter.rel_value_us;
+  return delay;
+}
+
+
+/**
+ * Should a message crossing an emulated link be lost?
+ *
+ * @param loss loss probability in parts per million
+ * @return #GNUNET_YES if the message should be dropped
+ */
+static int
+draw_loss (uint32_t loss)
+{
+  if (0 == loss)
+    return GNUNET_NO;
+  if (GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                1000000) < loss)
+    return GNUNET_YES;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Compute until when a message occupies the bandwidth of an
+ * emulated link.
+ *
+ * @param busy until when the link is already occupied
+ * @param bandwidth bandwidth of the link in bytes/s, 0 for no cap
+ * @param size size of the message
+ * @return time when the last byte of the message is on the link
+ */
+static struct GNUNET_TIME_Absolute
+serialize (struct GNUNET_TIME_Absolute busy,
+           uint32_t bandwidth,
+           size_t size)
+{
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative duration;
+
+  start = GNUNET_TIME_absolute_max (busy,
+                                    GNUNET_TIME_absolute_get ());
+  if (0 == bandwidth)
+    return start;
+  duration.rel_value_us = (uint64_t) size * 1000000LLU / bandwidth;
+  return GNUNET_TIME_absolute_add (start,
+                                   duration);
+}
+
+
+static void
+send_delayed (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * (Re)schedule the task sending the head of the queue of a link.
+ *
+ * @param link the link
+ */
+static void
+schedule_link (struct TM_Link *link)
+{
+  if (NULL != link->send_delay_task)
+  {
+    GNUNET_SCHEDULER_cancel (link->send_delay_task);
+    link->send_delay_task = NULL;
+  }
+  if (NULL == link->send_head)
+    return;
+  link->send_delay_task
+    = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining (link->send_head->sent_at),
+                                    &send_delayed,
+                                    link);
+}
+
+
 /**
  * We have delayed transmission, now it is time to send the
- * message.
+ * messages that are due.
  *
- * @param cls the `struct DelayQueueEntry` to transmit
+ * @param cls the `struct TM_Link` to transmit on
  * @param tc unused
  */
 static void
 send_delayed (void *cls,
               const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
-  struct DelayQueueEntry *dqe = cls;
-  struct DelayQueueEntry *next;
-  struct TM_Peer *tmp = dqe->tmp;
-  struct GNUNET_TIME_Relative delay;
+  struct TM_Link *link = cls;
+  struct DelayQueueEntry *dqe;
 
-  GNUNET_break (GNUNET_YES ==
-                GST_neighbours_test_connected (&dqe->id));
-  if (NULL != tmp)
+  link->send_delay_task = NULL;
+  while ( (NULL != (dqe = link->send_head)) &&
+          (0 == GNUNET_TIME_absolute_get_remaining (dqe->sent_at).rel_value_us) )
   {
-    tmp->send_delay_task = NULL;
-    GNUNET_CONTAINER_DLL_remove (tmp->send_head,
-                                 tmp->send_tail,
+    GNUNET_CONTAINER_DLL_remove (link->send_head,
+                                 link->send_tail,
                                  dqe);
-    next = tmp->send_head;
-    if (NULL != next)
-    {
-      /* More delayed messages */
-      delay = GNUNET_TIME_absolute_get_remaining(next->sent_at);
-      tmp->send_delay_task = GNUNET_SCHEDULER_add_delayed(delay,
-                                                          &send_delayed, next);
-    }
+    GNUNET_break (GNUNET_YES ==
+                  GST_neighbours_test_connected (&dqe->id));
+    GST_neighbours_send (&dqe->id,
+                         dqe->msg,
+                         dqe->msg_size,
+                         dqe->timeout,
+                         dqe->cont,
+                         dqe->cont_cls);
+    GNUNET_free (dqe);
   }
-  else
+  schedule_link (link);
+}
+
+
+/**
+ * Fail the queued messages of a link.
+ *
+ * @param link the link
+ * @param peer only fail messages to this peer, NULL for all
+ */
+static void
+flush_link (struct TM_Link *link,
+            const struct GNUNET_PeerIdentity *peer)
+{
+  struct DelayQueueEntry *dqe;
+  struct DelayQueueEntry *next;
+
+  next = link->send_head;
+  while (NULL != (dqe = next))
   {
-    /* Remove from generic queue */
-    generic_send_delay_task = NULL;
-    GNUNET_CONTAINER_DLL_remove (generic_dqe_head,
-                                 generic_dqe_tail,
+    next = dqe->next;
+    if ( (NULL != peer) &&
+         (0 != memcmp (peer,
+                       &dqe->id,
+                       sizeof (dqe->id))) )
+      continue;
+    GNUNET_CONTAINER_DLL_remove (link->send_head,
+                                 link->send_tail,
                                  dqe);
-    next = generic_dqe_head;
-    if (NULL != next)
-    {
-      /* More delayed messages */
-      delay = GNUNET_TIME_absolute_get_remaining(next->sent_at);
-      generic_send_delay_task = GNUNET_SCHEDULER_add_delayed (delay,
-                                                              &send_delayed,
-                                                              next);
-    }
+    if (NULL != dqe->cont)
+      dqe->cont (dqe->cont_cls,
+                 GNUNET_SYSERR,
+                 dqe->msg_size,
+                 0);
+    GNUNET_free (dqe);
   }
-  GST_neighbours_send (&dqe->id,
-                       dqe->msg,
-                       dqe->msg_size,
-                       dqe->timeout,
-                       dqe->cont,
-                       dqe->cont_cls);
-  GNUNET_free(dqe);
+  schedule_link (link);
 }
 
 
 /**
  * Adapter function between transport's send function and transport plugins.
- * Delays message transmission if an artificial delay is configured.
+ * Delays, drops or reorders message transmission if link emulation is
+ * configured.
  *
  * @param target the peer the message to send to
  * @param msg the message received
@@ -298,17 +532,18 @@ GST_manipulation_send (const struct GNUNET_PeerIdentity *target,
                        GST_NeighbourSendContinuation cont,
                        void *cont_cls)
 {
-  struct TM_Peer *tmp;
+  struct TM_Link *link;
   struct DelayQueueEntry *dqe;
-  struct GNUNET_TIME_Relative delay;
+  struct DelayQueueEntry *pos;
+  struct GNUNET_TIME_Absolute busy;
+  struct GNUNET_TIME_Absolute sent_at;
 
-  if (NULL != (tmp =
-               GNUNET_CONTAINER_multipeermap_get (peers,
-                                                  target)))
-    delay = tmp->delay_out;
-  else
-    delay = delay_out;
-  if (0 == delay.rel_value_us)
+  link = get_link (target);
+  if ( (0 == link->ep.delay_out.rel_value_us) &&
+       (0 == link->ep.jitter_out.rel_value_us) &&
+       (0 == link->ep.bandwidth_out) &&
+       (0 == link->ep.loss_out) &&
+       (NULL == link->send_head) )
   {
     /* Normal sending */
     GST_neighbours_send (target,
@@ -318,10 +553,50 @@ GST_manipulation_send (const struct GNUNET_PeerIdentity *target,
                          cont, cont_cls);
     return;
   }
+  busy = serialize (link->busy_out,
+                    link->ep.bandwidth_out,
+                    msg_size);
+  if (GNUNET_TIME_absolute_get_remaining (busy).rel_value_us >
+      timeout.rel_value_us)
+  {
+    /* queue of the bottleneck is longer than the message may wait */
+    GNUNET_STATISTICS_update (GST_stats,
+                              gettext_noop ("# messages timed out in emulated link queue"),
+                              1,
+                              GNUNET_NO);
+    if (NULL != cont)
+      cont (cont_cls,
+            GNUNET_SYSERR,
+            msg_size,
+            0);
+    return;
+  }
+  link->busy_out = busy;
+  if (GNUNET_YES == draw_loss (link->ep.loss_out))
+  {
+    /* lost "on the wire", so to the sender it looks transmitted */
+    GNUNET_STATISTICS_update (GST_stats,
+                              gettext_noop ("# messages dropped by emulated link"),
+                              1,
+                              GNUNET_NO);
+    if (NULL != cont)
+      cont (cont_cls,
+            GNUNET_OK,
+            msg_size,
+            msg_size);
+    return;
+  }
+  sent_at = GNUNET_TIME_absolute_add (busy,
+                                      draw_delay (link->ep.delay_out,
+                                                  link->ep.jitter_out));
+  if ( (GNUNET_YES != link->ep.reorder) &&
+       (NULL != link->send_tail) )
+    sent_at = GNUNET_TIME_absolute_max (sent_at,
+                                        link->send_tail->sent_at);
   dqe = GNUNET_malloc (sizeof (struct DelayQueueEntry) + msg_size);
   dqe->id = *target;
-  dqe->tmp = tmp;
-  dqe->sent_at = GNUNET_TIME_relative_to_absolute (delay);
+  dqe->link = link;
+  dqe->sent_at = sent_at;
   dqe->cont = cont;
   dqe->cont_cls = cont_cls;
   dqe->msg = &dqe[1];
@@ -330,31 +605,21 @@ GST_manipulation_send (const struct GNUNET_PeerIdentity *target,
   memcpy (dqe->msg,
           msg,
           msg_size);
-  if (NULL == tmp)
-  {
-    GNUNET_CONTAINER_DLL_insert_tail (generic_dqe_head,
-                                      generic_dqe_tail,
-                                      dqe);
-    if (NULL == generic_send_delay_task)
-      generic_send_delay_task = GNUNET_SCHEDULER_add_delayed (delay,
-                                                              &send_delayed,
-                                                              dqe);
-  }
-  else
-  {
-    GNUNET_CONTAINER_DLL_insert_tail (tmp->send_head,
-                                      tmp->send_tail,
-                                      dqe);
-    if (NULL == tmp->send_delay_task)
-      tmp->send_delay_task = GNUNET_SCHEDULER_add_delayed (delay,
-                                                           &send_delayed,
-                                                           dqe);
-  }
+  /* keep the queue sorted; without reordering we always append */
+  for (pos = link->send_tail;
+       (NULL != pos) && (pos->sent_at.abs_value_us > sent_at.abs_value_us);
+       pos = pos->prev) ;
+  GNUNET_CONTAINER_DLL_insert_after (link->send_head,
+                                     link->send_tail,
+                                     pos,
+                                     dqe);
+  if (link->send_head == dqe)
+    schedule_link (link);
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-              "Delaying %u byte message to peer `%s' with peer specific delay for %s\n",
+              "Delaying %u byte message to peer `%s' for %s\n",
               msg_size,
               GNUNET_i2s (target),
-              GNUNET_STRINGS_relative_time_to_string (delay,
+              GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_remaining (sent_at),
                                                       GNUNET_YES));
 }
 
@@ -398,17 +663,29 @@ GST_manipulation_recv (void *cls,
                        struct Session *session,
                        const struct GNUNET_MessageHeader *message)
 {
-  struct TM_Peer *tmp;
+  struct TM_Link *link;
   struct GNUNET_TIME_Relative quota_delay;
   struct GNUNET_TIME_Relative m_delay;
 
-  if (NULL !=
-      (tmp = GNUNET_CONTAINER_multipeermap_get (peers,
-                                                &address->peer)))
-    m_delay = tmp->delay_in;
-  else
-    m_delay = delay_in;
-
+  link = get_link (&address->peer);
+  m_delay = draw_delay (link->ep.delay_in,
+                        link->ep.jitter_in);
+  if (0 != link->ep.bandwidth_in)
+  {
+    link->busy_in = serialize (link->busy_in,
+                               link->ep.bandwidth_in,
+                               ntohs (message->size));
+    m_delay = GNUNET_TIME_relative_max (m_delay,
+                                        GNUNET_TIME_absolute_get_remaining (link->busy_in));
+  }
+  if (GNUNET_YES == draw_loss (link->ep.loss_in))
+  {
+    GNUNET_STATISTICS_update (GST_stats,
+                              gettext_noop ("# messages dropped by emulated link"),
+                              1,
+                              GNUNET_NO);
+    return m_delay;
+  }
   quota_delay = GST_receive_callback (cls,
                                       address,
                                       session,
@@ -424,39 +701,291 @@ GST_manipulation_recv (void *cls,
 }
 
 
+/**
+ * Change an option of the link emulation.
+ *
+ * @param ep emulation parameters to change
+ * @param option name of the option, i.e. "DELAY_IN", "DELAY_OUT",
+ *        "JITTER_IN", "JITTER_OUT", "BANDWIDTH_IN", "BANDWIDTH_OUT",
+ *        "LOSS_IN", "LOSS_OUT" (in percent) or "REORDER"
+ * @param value new value of the option
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a option
+ *         or @a value are malformed
+ */
+static int
+apply_option (struct GNUNET_TRANSPORT_EmulationParameters *ep,
+              const char *option,
+              const char *value)
+{
+  struct GNUNET_TIME_Relative *rel;
+  uint32_t *u32;
+  unsigned long long size;
+  double percent;
+  char *end;
+
+  rel = NULL;
+  u32 = NULL;
+  if (0 == strcasecmp (option, "DELAY_IN"))
+    rel = &ep->delay_in;
+  else if (0 == strcasecmp (option, "DELAY_OUT"))
+    rel = &ep->delay_out;
+  else if (0 == strcasecmp (option, "JITTER_IN"))
+    rel = &ep->jitter_in;
+  else if (0 == strcasecmp (option, "JITTER_OUT"))
+    rel = &ep->jitter_out;
+  if (NULL != rel)
+    return GNUNET_STRINGS_fancy_time_to_relative (value,
+                                                  rel);
+  if (0 == strcasecmp (option, "BANDWIDTH_IN"))
+    u32 = &ep->bandwidth_in;
+  else if (0 == strcasecmp (option, "BANDWIDTH_OUT"))
+    u32 = &ep->bandwidth_out;
+  if (NULL != u32)
+  {
+    if ( (GNUNET_OK !=
+          GNUNET_STRINGS_fancy_size_to_bytes (value,
+                                              &size)) ||
+         (size > UINT32_MAX) )
+      return GNUNET_SYSERR;
+    *u32 = (uint32_t) size;
+    return GNUNET_OK;
+  }
+  if (0 == strcasecmp (option, "LOSS_IN"))
+    u32 = &ep->loss_in;
+  else if (0 == strcasecmp (option, "LOSS_OUT"))
+    u32 = &ep->loss_out;
+  if (NULL != u32)
+  {
+    percent = strtod (value, &end);
+    if ( (end == value) ||
+         (percent < 0.0) ||
+         (percent > 100.0) )
+      return GNUNET_SYSERR;
+    *u32 = (uint32_t) (percent * 10000.0 + 0.5);
+    return GNUNET_OK;
+  }
+  if (0 == strcasecmp (option, "REORDER"))
+  {
+    if ( (0 == strcasecmp (value, "YES")) ||
+         (0 == strcasecmp (value, "TRUE")) )
+      ep->reorder = GNUNET_YES;
+    else if ( (0 == strcasecmp (value, "NO")) ||
+              (0 == strcasecmp (value, "FALSE")) )
+      ep->reorder = GNUNET_NO;
+    else
+      return GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  return GNUNET_SYSERR;
+}
+
+
+/**
+ * Apply the events of the timeline that are due.
+ *
+ * @param cls NULL
+ * @param tc unused
+ */
+static void
+run_timeline (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_TIME_Relative elapsed;
+  struct TimelineEvent *ev;
+
+  timeline_task = NULL;
+  elapsed = GNUNET_TIME_absolute_get_duration (timeline_start);
+  while ( (timeline_pos < timeline_len) &&
+          (timeline[timeline_pos].offset.rel_value_us <= elapsed.rel_value_us) )
+  {
+    ev = &timeline[timeline_pos++];
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                "Setting emulated %s to %s\n",
+                ev->option,
+                ev->value);
+    GNUNET_break (GNUNET_OK ==
+                  apply_option (&generic_link.ep,
+                                ev->option,
+                                ev->value));
+  }
+  if (timeline_pos < timeline_len)
+    timeline_task
+      = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_subtract (timeline[timeline_pos].offset,
+                                                                     elapsed),
+                                      &run_timeline,
+                                      NULL);
+}
+
+
+/**
+ * Compare two timeline events by offset, for qsort().
+ *
+ * @param a first `struct TimelineEvent`
+ * @param b second `struct TimelineEvent`
+ * @return -1, 0 or 1
+ */
+static int
+cmp_event (const void *a,
+           const void *b)
+{
+  const struct TimelineEvent *ea = a;
+  const struct TimelineEvent *eb = b;
+
+  if (ea->offset.rel_value_us < eb->offset.rel_value_us)
+    return -1;
+  if (ea->offset.rel_value_us > eb->offset.rel_value_us)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Load a timeline of changes to the emulated default link.  Each
+ * line of the file has the form "OFFSET;OPTION;VALUE", for example
+ * "30 s;BANDWIDTH_OUT;64 KiB"; empty lines and lines starting with
+ * '#' are ignored.
+ *
+ * @param filename name of the file
+ * @return #GNUNET_OK on success
+ */
+static int
+load_timeline (const char *filename)
+{
+  struct GNUNET_TRANSPORT_EmulationParameters check;
+  struct TimelineEvent ev;
+  uint64_t fsize;
+  char *data;
+  char *line;
+  char *next;
+  char *option;
+  char *value;
+  unsigned int lineno;
+
+  if ( (GNUNET_OK !=
+        GNUNET_DISK_file_size (filename,
+                               &fsize,
+                               GNUNET_YES,
+                               GNUNET_YES)) ||
+       (fsize > 1024 * 1024) )
+    return GNUNET_SYSERR;
+  data = GNUNET_malloc (fsize + 1);
+  if (fsize != GNUNET_DISK_fn_read (filename,
+                                    data,
+                                    fsize))
+  {
+    GNUNET_free (data);
+    return GNUNET_SYSERR;
+  }
+  data[fsize] = '\0';
+  lineno = 0;
+  for (line = data; NULL != line; line = next)
+  {
+    lineno++;
+    next = strchr (line, '\n');
+    if (NULL != next)
+      *(next++) = '\0';
+    if ( ('\0' == line[0]) ||
+         ('#' == line[0]) )
+      continue;
+    option = strchr (line, ';');
+    value = (NULL == option) ? NULL : strchr (option + 1, ';');
+    if (NULL == value)
+      goto malformed;
+    *(option++) = '\0';
+    *(value++) = '\0';
+    check = generic_link.ep;
+    if ( (GNUNET_OK !=
+          GNUNET_STRINGS_fancy_time_to_relative (line,
+                                                 &ev.offset)) ||
+         (GNUNET_OK !=
+          apply_option (&check,
+                        option,
+                        value)) )
+      goto malformed;
+    ev.option = GNUNET_strdup (option);
+    ev.value = GNUNET_strdup (value);
+    GNUNET_array_append (timeline,
+                         timeline_len,
+                         ev);
+  }
+  GNUNET_free (data);
+  qsort (timeline,
+         timeline_len,
+         sizeof (struct TimelineEvent),
+         &cmp_event);
+  return GNUNET_OK;
+ malformed:
+  GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+              _("Malformed line %u in link emulation timeline `%s'\n"),
+              lineno,
+              filename);
+  GNUNET_free (data);
+  return GNUNET_SYSERR;
+}
+
+
 /**
  * Initialize traffic manipulation
  */
 void
 GST_manipulation_init ()
 {
-  struct GNUNET_TIME_Relative delay;
-
-  if ( (GNUNET_OK ==
-        GNUNET_CONFIGURATION_get_value_time (GST_cfg,
-                                             "transport",
-                                             "MANIPULATE_DELAY_IN",
-                                             &delay)) &&
-       (delay.rel_value_us > 0) )
+  static const char *options[] = {
+    "DELAY_IN", "DELAY_OUT", "JITTER_IN", "JITTER_OUT",
+    "BANDWIDTH_IN", "BANDWIDTH_OUT", "LOSS_IN", "LOSS_OUT",
+    "REORDER", NULL
+  };
+  char *name;
+  char *value;
+  char *fn;
+  unsigned int i;
+
+  for (i = 0; NULL != options[i]; i++)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Delaying inbound traffic for %s\n",
-                GNUNET_STRINGS_relative_time_to_string (delay,
-                                                        GNUNET_YES));
-    delay_in = delay;
+    GNUNET_asprintf (&name,
+                     "MANIPULATE_%s",
+                     options[i]);
+    if (GNUNET_OK ==
+        GNUNET_CONFIGURATION_get_value_string (GST_cfg,
+                                               "transport",
+                                               name,
+                                               &value))
+    {
+      if (GNUNET_OK !=
+          apply_option (&generic_link.ep,
+                        options[i],
+                        value))
+        GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_WARNING,
+                                   "transport",
+                                   name,
+                                   _("malformed value"));
+      else
+        GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                    "Emulating %s of %s for all peers\n",
+                    options[i],
+                    value);
+      GNUNET_free (value);
+    }
+    GNUNET_free (name);
   }
-  if ( (GNUNET_OK ==
-        GNUNET_CONFIGURATION_get_value_time (GST_cfg,
-                                             "transport",
-                                             "MANIPULATE_DELAY_OUT",
-                                             &delay)) &&
-       (delay.rel_value_us > 0) )
+  if (GNUNET_OK ==
+      GNUNET_CONFIGURATION_get_value_filename (GST_cfg,
+                                               "transport",
+                                               "MANIPULATE_TIMELINE",
+                                               &fn))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "Delaying outbound traffic for %s\n",
-                GNUNET_STRINGS_relative_time_to_string (delay,
-                                                        GNUNET_YES));
-    delay_out = delay;
+    if (GNUNET_OK == load_timeline (fn))
+    {
+      timeline_start = GNUNET_TIME_absolute_get ();
+      timeline_task = GNUNET_SCHEDULER_add_now (&run_timeline,
+                                                NULL);
+    }
+    else
+      GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_WARNING,
+                                 "transport",
+                                 "MANIPULATE_TIMELINE",
+                                 _("cannot load timeline"));
+    GNUNET_free (fn);
   }
   peers = GNUNET_CONTAINER_multipeermap_create (4,
                                                 GNUNET_NO);
@@ -472,53 +1001,14 @@ void
 GST_manipulation_peer_disconnect (const struct GNUNET_PeerIdentity *peer)
 {
   struct TM_Peer *tmp;
-  struct DelayQueueEntry *dqe;
-  struct DelayQueueEntry *next;
 
   tmp = GNUNET_CONTAINER_multipeermap_get (peers,
                                            peer);
   if (NULL != tmp)
-  {
-    while (NULL != (dqe = tmp->send_head))
-    {
-      GNUNET_CONTAINER_DLL_remove (tmp->send_head,
-                                   tmp->send_tail,
-                                   dqe);
-      if (NULL != dqe->cont)
-        dqe->cont (dqe->cont_cls,
-                   GNUNET_SYSERR,
-                   dqe->msg_size,
-                   0);
-      GNUNET_free(dqe);
-    }
-  }
-  next = generic_dqe_head;
-  while (NULL != (dqe = next))
-  {
-    next = dqe->next;
-    if (0 == memcmp(peer, &dqe->id, sizeof(dqe->id)))
-    {
-      GNUNET_CONTAINER_DLL_remove (generic_dqe_head,
-                                   generic_dqe_tail,
-                                   dqe);
-      if (NULL != dqe->cont)
-        dqe->cont (dqe->cont_cls,
-                   GNUNET_SYSERR,
-                   dqe->msg_size,
-                   0);
-      GNUNET_free(dqe);
-    }
-  }
-  if (NULL != generic_send_delay_task)
-  {
-    GNUNET_SCHEDULER_cancel (generic_send_delay_task);
-    generic_send_delay_task = NULL;
-    if (NULL != generic_dqe_head)
-      generic_send_delay_task
-        = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_absolute_get_remaining(generic_dqe_head->sent_at),
-                                        &send_delayed,
-                                        generic_dqe_head);
-  }
+    flush_link (&tmp->link,
+                NULL);
+  flush_link (&generic_link,
+              peer);
 }
 
 
@@ -536,29 +1026,13 @@ free_tmps (void *cls,
            void *value)
 {
   struct TM_Peer *tmp = value;
-  struct DelayQueueEntry *dqe;
 
   GNUNET_break (GNUNET_YES ==
                 GNUNET_CONTAINER_multipeermap_remove (peers,
                                                       key,
                                                       value));
-  while (NULL != (dqe = tmp->send_head))
-  {
-    GNUNET_CONTAINER_DLL_remove (tmp->send_head,
-                                 tmp->send_tail,
-                                 dqe);
-    if (NULL != dqe->cont)
-      dqe->cont (dqe->cont_cls,
-                 GNUNET_SYSERR,
-                 dqe->msg_size,
-                 0);
-    GNUNET_free (dqe);
-  }
-  if (NULL != tmp->send_delay_task)
-  {
-    GNUNET_SCHEDULER_cancel (tmp->send_delay_task);
-    tmp->send_delay_task = NULL;
-  }
+  flush_link (&tmp->link,
+              NULL);
   GNUNET_free (tmp);
   return GNUNET_OK;
 }
@@ -570,30 +1044,29 @@ free_tmps (void *cls,
 void
 GST_manipulation_stop ()
 {
-  struct DelayQueueEntry *cur;
+  unsigned int i;
 
   GNUNET_CONTAINER_multipeermap_iterate (peers,
                                          &free_tmps,
                                          NULL);
   GNUNET_CONTAINER_multipeermap_destroy (peers);
   peers = NULL;
-  while (NULL != (cur = generic_dqe_head))
+  flush_link (&generic_link,
+              NULL);
+  if (NULL != timeline_task)
   {
-    GNUNET_CONTAINER_DLL_remove (generic_dqe_head,
-                                 generic_dqe_tail,
-                                 cur);
-    if (NULL != cur->cont)
-      cur->cont (cur->cont_cls,
-                 GNUNET_SYSERR,
-                 cur->msg_size,
-                 0);
-    GNUNET_free (cur);
+    GNUNET_SCHEDULER_cancel (timeline_task);
+    timeline_task = NULL;
   }
-  if (NULL != generic_send_delay_task)
+  for (i = 0; i < timeline_len; i++)
   {
-    GNUNET_SCHEDULER_cancel (generic_send_delay_task);
-    generic_send_delay_task = NULL;
+    GNUNET_free (timeline[i].option);
+    GNUNET_free (timeline[i].value);
   }
+  GNUNET_array_grow (timeline,
+                     timeline_len,
+                     0);
+  timeline_pos = 0;
 }
 
 /* end of file gnunet-service-transport_manipulation.c */
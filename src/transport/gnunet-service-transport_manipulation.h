@@ -51,6 +51,19 @@ GST_manipulation_set_metric (void *cls,
                              const struct GNUNET_MessageHeader *message);
 
 
+/**
+ * Set link characteristics to emulate
+ *
+ * @param cls closure
+ * @param client client sending message
+ * @param message containing information
+ */
+void
+GST_manipulation_set_emulation (void *cls,
+                                struct GNUNET_SERVER_Client *client,
+                                const struct GNUNET_MessageHeader *message);
+
+
 /**
  * Adapter function between transport's send function and transport plugins
  *
@@ -453,6 +453,22 @@ struct NeighbourMapEntry
    * Date of last utilization transmission
    */
   struct GNUNET_TIME_Absolute last_util_transmission;
+
+  /**
+   * Neighbours with utilization to report are kept in a DLL.
+   */
+  struct NeighbourMapEntry *next_util;
+
+  /**
+   * Neighbours with utilization to report are kept in a DLL.
+   */
+  struct NeighbourMapEntry *prev_util;
+
+  /**
+   * Is this neighbour in the DLL of neighbours with utilization
+   * to report?
+   */
+  int in_util_list;
 };
 
 
@@ -527,6 +543,24 @@ static unsigned long long bytes_in_send_queue;
  */
 static struct GNUNET_SCHEDULER_Task *util_transmission_tk;
 
+/**
+ * Head of DLL of neighbours that sent or received data since we
+ * last sent their utilization to ATS (or that still need to report
+ * that they became idle).
+ */
+static struct NeighbourMapEntry *util_head;
+
+/**
+ * Tail of DLL of neighbours that sent or received data since we
+ * last sent their utilization to ATS.
+ */
+static struct NeighbourMapEntry *util_tail;
+
+/**
+ * When did #utilization_transmission() last run?
+ */
+static struct GNUNET_TIME_Absolute last_util_round;
+
 
 /**
  * Convert the given ACK state to a string.
@@ -1014,6 +1048,14 @@ free_neighbour (struct NeighbourMapEntry *n)
   GNUNET_assert (GNUNET_YES ==
                  GNUNET_CONTAINER_multipeermap_remove (neighbours,
                                                        &n->id, n));
+  if (GNUNET_YES == n->in_util_list)
+  {
+    GNUNET_CONTAINER_MDLL_remove (util,
+                                  util_head,
+                                  util_tail,
+                                  n);
+    n->in_util_list = GNUNET_NO;
+  }
 
   /* Cancel address requests for this peer */
   if (NULL != n->suggest_handle)
@@ -2891,26 +2933,24 @@ GST_neighbours_switch_to_address (const struct GNUNET_HELLO_Address *address,
 
 /**
  * Function called to send network utilization data to ATS for
- * each active connection.
+ * an active connection.
  *
- * @param cls NULL
- * @param key peer we send utilization data for
- * @param value the `struct NeighbourMapEntry *` with data to send
- * @return #GNUNET_OK (continue to iterate)
+ * @param n the neighbour with data to send
+ * @return #GNUNET_YES if the neighbour had some traffic to report
  */
 static int
-send_utilization_data (void *cls,
-                       const struct GNUNET_PeerIdentity *key,
-                       void *value)
+send_utilization_data (struct NeighbourMapEntry *n)
 {
-  struct NeighbourMapEntry *n = value;
   uint32_t bps_in;
   uint32_t bps_out;
   struct GNUNET_TIME_Relative delta;
+  int active;
 
+  active = ( (0 != n->util_total_bytes_recv) ||
+             (0 != n->util_total_bytes_sent) );
   if ( (GNUNET_YES != test_connected (n)) ||
        (NULL == n->primary_address.address) )
-    return GNUNET_OK;
+    return active;
   delta = GNUNET_TIME_absolute_get_difference (n->last_util_transmission,
                                                GNUNET_TIME_absolute_get ());
   bps_in = 0;
@@ -2922,7 +2962,7 @@ send_utilization_data (void *cls,
 
   GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
               "`%s' total: received %u Bytes/s, sent %u Bytes/s\n",
-              GNUNET_i2s (key),
+              GNUNET_i2s (&n->id),
               bps_in,
               bps_out);
   GST_ats_update_utilization (n->primary_address.address,
@@ -2931,24 +2971,63 @@ send_utilization_data (void *cls,
   n->util_total_bytes_recv = 0;
   n->util_total_bytes_sent = 0;
   n->last_util_transmission = GNUNET_TIME_absolute_get ();
-  return GNUNET_OK;
+  return active;
 }
 
 
 /**
- * Task transmitting utilization in a regular interval
+ * Remember that we need to report the utilization of a neighbour
+ * with the next #utilization_transmission().
  *
- * @param cls the 'struct NeighbourMapEntry' for which we are running
+ * @param n the neighbour that sent or received data
+ */
+static void
+mark_utilization (struct NeighbourMapEntry *n)
+{
+  if (GNUNET_YES == n->in_util_list)
+    return;
+  /* the bytes count for the current interval, as if we had
+     reported the idle neighbour in every round */
+  n->last_util_transmission = GNUNET_TIME_absolute_max (n->last_util_transmission,
+                                                        last_util_round);
+  GNUNET_CONTAINER_MDLL_insert_tail (util,
+                                     util_head,
+                                     util_tail,
+                                     n);
+  n->in_util_list = GNUNET_YES;
+}
+
+
+/**
+ * Task transmitting utilization in a regular interval.  Only
+ * neighbours that had traffic since the last round are reported;
+ * each of them is reported once more after it went idle, so that
+ * ATS learns that the utilization dropped to zero.
+ *
+ * @param cls NULL
  * @param tc scheduler context (unused)
  */
 static void
 utilization_transmission (void *cls,
                           const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
+  struct NeighbourMapEntry *n;
+  struct NeighbourMapEntry *next;
+
   util_transmission_tk = NULL;
-  GNUNET_CONTAINER_multipeermap_iterate (neighbours,
-                                         &send_utilization_data,
-                                         NULL);
+  next = util_head;
+  while (NULL != (n = next))
+  {
+    next = n->next_util;
+    if (GNUNET_YES == send_utilization_data (n))
+      continue;
+    GNUNET_CONTAINER_MDLL_remove (util,
+                                  util_head,
+                                  util_tail,
+                                  n);
+    n->in_util_list = GNUNET_NO;
+  }
+  last_util_round = GNUNET_TIME_absolute_get ();
   util_transmission_tk
     = GNUNET_SCHEDULER_add_delayed (UTIL_TRANSMISSION_INTERVAL,
                                     &utilization_transmission,
@@ -2974,6 +3053,7 @@ GST_neighbours_notify_data_recv (const struct GNUNET_HELLO_Address *address,
   if (NULL == n)
     return;
   n->util_total_bytes_recv += ntohs (message->size);
+  mark_utilization (n);
 }
 
 
@@ -2999,6 +3079,7 @@ GST_neighbours_notify_data_sent (const struct GNUNET_HELLO_Address *address,
   if (n->primary_address.session != session)
     return;
   n->util_total_bytes_sent += size;
+  mark_utilization (n);
 }
 
 
@@ -3919,6 +4000,7 @@ GST_neighbours_start (unsigned int max_fds)
 {
   neighbours = GNUNET_CONTAINER_multipeermap_create (NEIGHBOUR_TABLE_SIZE,
                                                      GNUNET_NO);
+  last_util_round = GNUNET_TIME_absolute_get ();
   util_transmission_tk = GNUNET_SCHEDULER_add_delayed (UTIL_TRANSMISSION_INTERVAL,
                                                        &utilization_transmission,
                                                        NULL);
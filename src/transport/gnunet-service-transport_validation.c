@@ -94,6 +94,12 @@
  */
 #define PONG_PRIORITY 4
 
+/**
+ * How many PONG signatures do we verify at most at the same time
+ * for one address?
+ */
+#define MAX_PENDING_PONG_VERIFICATIONS 8
+
 
 GNUNET_NETWORK_STRUCT_BEGIN
 
@@ -173,6 +179,49 @@ struct TransportPongMessage
 };
 GNUNET_NETWORK_STRUCT_END
 
+
+struct ValidationEntry;
+
+
+/**
+ * PONG whose signature is being verified in the crypto offload pool.
+ */
+struct PongVerification
+{
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PongVerification *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct PongVerification *prev;
+
+  /**
+   * Validation entry the PONG is for.
+   */
+  struct ValidationEntry *ve;
+
+  /**
+   * Handle to the offloaded verification.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Signature of the PONG.
+   */
+  struct GNUNET_CRYPTO_EddsaSignature sig;
+
+  /**
+   * Expiration of the PONG.
+   */
+  struct GNUNET_TIME_Absolute expiration;
+
+};
+
+
 /**
  * Information about an address under validation
  */
@@ -194,6 +243,21 @@ struct ValidationEntry
    */
   struct GNUNET_CRYPTO_EddsaSignature pong_sig_cache;
 
+  /**
+   * Head of PONGs whose signatures are being verified.
+   */
+  struct PongVerification *pv_head;
+
+  /**
+   * Tail of PONGs whose signatures are being verified.
+   */
+  struct PongVerification *pv_tail;
+
+  /**
+   * Number of entries in the @e pv_head DLL.
+   */
+  unsigned int num_pong_verifications;
+
   /**
    * ID of task that will clean up this entry if nothing happens.
    */
@@ -394,6 +458,28 @@ validation_entry_changed (struct ValidationEntry *ve,
 }
 
 
+/**
+ * Cancel all pending verifications of PONGs for @a ve.
+ *
+ * @param ve the validation entry
+ */
+static void
+cancel_pong_verifications (struct ValidationEntry *ve)
+{
+  struct PongVerification *pv;
+
+  while (NULL != (pv = ve->pv_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (ve->pv_head,
+                                 ve->pv_tail,
+                                 pv);
+    GNUNET_CRYPTO_offload_cancel (pv->job);
+    GNUNET_free (pv);
+  }
+  ve->num_pong_verifications = 0;
+}
+
+
 /**
  * Iterate over validation entries and free them.
  *
@@ -421,6 +507,7 @@ cleanup_validation_entry (void *cls,
     GST_blacklist_test_cancel (ve->bc);
     ve->bc = NULL;
   }
+  cancel_pong_verifications (ve);
   GNUNET_break (GNUNET_OK ==
                 GNUNET_CONTAINER_multipeermap_remove (validation_map,
                                                       &ve->address->peer,
@@ -1337,6 +1424,130 @@ add_valid_peer_address (void *cls,
 }
 
 
+/**
+ * We received a PONG with a valid signature for @a ve, remember
+ * that the address is valid.
+ *
+ * @param ve the validation entry
+ * @param sig the signature of the PONG
+ * @param expiration until when the signature is valid
+ */
+static void
+validation_succeeded (struct ValidationEntry *ve,
+                      const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                      struct GNUNET_TIME_Absolute expiration)
+{
+  struct GNUNET_HELLO_Message *hello;
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Validation process successful for peer `%s' with plugin `%s' address `%s'\n",
+              GNUNET_i2s (&ve->address->peer),
+              ve->address->transport_name,
+              GST_plugins_a2s (ve->address));
+  GNUNET_STATISTICS_update (GST_stats,
+                            gettext_noop ("# validations succeeded"),
+                            1,
+                            GNUNET_NO);
+  /* validity achieved, remember it! */
+  ve->expecting_pong = GNUNET_NO;
+  ve->valid_until = GNUNET_TIME_relative_to_absolute (HELLO_ADDRESS_EXPIRATION);
+  ve->pong_sig_cache = *sig;
+  ve->pong_sig_valid_until = expiration;
+  ve->latency = GNUNET_TIME_absolute_get_duration (ve->send_time);
+  {
+    if (GNUNET_YES == ve->known_to_ats)
+    {
+      GST_ats_update_delay (ve->address,
+                            GNUNET_TIME_relative_divide (ve->latency, 2));
+    }
+    else
+    {
+      struct GNUNET_ATS_Properties prop;
+
+      memset (&prop, 0, sizeof (prop));
+      prop.scope = ve->network;
+      prop.delay = GNUNET_TIME_relative_divide (ve->latency, 2);
+      ve->known_to_ats = GNUNET_YES;
+      GST_ats_add_address (ve->address, &prop);
+    }
+  }
+  if (validations_running > 0)
+  {
+    validations_running--;
+    GNUNET_STATISTICS_set (GST_stats,
+                           gettext_noop ("# validations running"),
+                           validations_running,
+                           GNUNET_NO);
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Validation finished, %u validation processes running\n",
+                validations_running);
+  }
+  else
+  {
+    GNUNET_break (0);
+  }
+
+  /* Notify about new validity */
+  validation_entry_changed (ve,
+                            GNUNET_TRANSPORT_VS_UPDATE);
+
+  /* build HELLO to store in PEERINFO */
+  ve->copied = GNUNET_NO;
+  hello = GNUNET_HELLO_create (&ve->address->peer.public_key,
+                               &add_valid_peer_address,
+			       ve,
+                               GNUNET_NO);
+  GNUNET_PEERINFO_add_peer (GST_peerinfo,
+			    hello,
+			    NULL,
+			    NULL);
+  GNUNET_free (hello);
+}
+
+
+/**
+ * The crypto offload pool is done verifying the signature of
+ * a PONG.  The first valid PONG completes the validation, the
+ * verifications of other PONGs still pending are then cancelled.
+ *
+ * @param cls the `struct PongVerification`
+ * @param result #GNUNET_OK if the signature is valid
+ */
+static void
+pong_verified (void *cls,
+               int result)
+{
+  struct PongVerification *pv = cls;
+  struct ValidationEntry *ve = pv->ve;
+  struct GNUNET_CRYPTO_EddsaSignature sig;
+  struct GNUNET_TIME_Absolute expiration;
+
+  GNUNET_CONTAINER_DLL_remove (ve->pv_head,
+                               ve->pv_tail,
+                               pv);
+  ve->num_pong_verifications--;
+  sig = pv->sig;
+  expiration = pv->expiration;
+  GNUNET_free (pv);
+  if (GNUNET_OK != result)
+  {
+    GNUNET_break_op (0);
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                "Failed to verify: invalid signature on address `%s':%s from peer `%s'\n",
+                ve->address->transport_name,
+                GST_plugins_a2s (ve->address),
+                GNUNET_i2s (&ve->address->peer));
+    return;
+  }
+  cancel_pong_verifications (ve);
+  if (GNUNET_NO == ve->expecting_pong)
+    return;
+  validation_succeeded (ve,
+                        &sig,
+                        expiration);
+}
+
+
 /**
  * We've received a PONG.  Check if it matches a pending PING and
  * mark the respective address as confirmed.
@@ -1356,8 +1567,8 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
   size_t addrlen;
   size_t slen;
   size_t size;
-  struct GNUNET_HELLO_Message *hello;
   struct GNUNET_HELLO_Address address;
+  struct PongVerification *pv;
   int sig_res;
   int do_verify;
 
@@ -1433,12 +1644,19 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
   if (0 != GNUNET_TIME_absolute_get_remaining (ve->pong_sig_valid_until).rel_value_us)
   {
     /* We have a cached and valid signature for this peer,
-     * try to compare instead of verify */
-    if (0 == memcmp (&ve->pong_sig_cache,
-                     &pong->signature,
-                     sizeof (struct GNUNET_CRYPTO_EddsaSignature)))
+     * try to compare instead of verify; the signature covers
+     * the expiration, so it must be the same as well */
+    if ( (GNUNET_TIME_absolute_ntoh (pong->expiration).abs_value_us ==
+          ve->pong_sig_valid_until.abs_value_us) &&
+         (0 == memcmp (&ve->pong_sig_cache,
+                       &pong->signature,
+                       sizeof (struct GNUNET_CRYPTO_EddsaSignature))) )
     {
       /* signatures are identical, we can skip verification */
+      GNUNET_STATISTICS_update (GST_stats,
+                                gettext_noop
+                                ("# PONG signatures found in cache"),
+                                1, GNUNET_NO);
       sig_res = GNUNET_OK;
       do_verify = GNUNET_NO;
     }
@@ -1451,90 +1669,57 @@ GST_validation_handle_pong (const struct GNUNET_PeerIdentity *sender,
 
   if (GNUNET_YES == do_verify)
   {
-    /* Do expensive verification */
-    sig_res = GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_TRANSPORT_PONG_OWN,
-                                          &pong->purpose,
-                                          &pong->signature,
-                                          &ve->address->peer.public_key);
-    if (sig_res == GNUNET_SYSERR)
+    /* Do expensive verification in the crypto offload pool; each
+       PONG gets its own job, so that a bogus PONG cannot keep us
+       from accepting the genuine one */
+    for (pv = ve->pv_head; NULL != pv; pv = pv->next)
+      if ( (pv->expiration.abs_value_us ==
+            GNUNET_TIME_absolute_ntoh (pong->expiration).abs_value_us) &&
+           (0 == memcmp (&pv->sig,
+                         &pong->signature,
+                         sizeof (struct GNUNET_CRYPTO_EddsaSignature))) )
+        break;
+    if (NULL != pv)
     {
-      GNUNET_break_op (0);
-      GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-                  "Failed to verify: invalid signature on address `%s':%s from peer `%s'\n",
-                  tname,
-                  GST_plugins_a2s (ve->address),
-                  GNUNET_i2s (sender));
+      GNUNET_STATISTICS_update (GST_stats,
+                                gettext_noop
+                                ("# PONGs dropped, same PONG already being verified"),
+                                1, GNUNET_NO);
+      return GNUNET_OK;
     }
+    if (MAX_PENDING_PONG_VERIFICATIONS <= ve->num_pong_verifications)
+    {
+      GNUNET_STATISTICS_update (GST_stats,
+                                gettext_noop
+                                ("# PONGs dropped, too many verifications pending"),
+                                1, GNUNET_NO);
+      return GNUNET_OK;
+    }
+    pv = GNUNET_new (struct PongVerification);
+    pv->ve = ve;
+    pv->sig = pong->signature;
+    pv->expiration = GNUNET_TIME_absolute_ntoh (pong->expiration);
+    GNUNET_CONTAINER_DLL_insert_tail (ve->pv_head,
+                                      ve->pv_tail,
+                                      pv);
+    ve->num_pong_verifications++;
+    pv->job
+      = GNUNET_CRYPTO_eddsa_verify_offload (GNUNET_SIGNATURE_PURPOSE_TRANSPORT_PONG_OWN,
+                                            &pong->purpose,
+                                            &pong->signature,
+                                            &ve->address->peer.public_key,
+                                            &pong_verified,
+                                            pv);
+    return GNUNET_OK;
   }
   if (sig_res == GNUNET_SYSERR)
   {
     GNUNET_break_op (0);
     return GNUNET_SYSERR;
   }
-
-  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-              "Validation process successful for peer `%s' with plugin `%s' address `%s'\n",
-              GNUNET_i2s (sender),
-              tname,
-              GST_plugins_a2s (ve->address));
-  GNUNET_STATISTICS_update (GST_stats,
-                            gettext_noop ("# validations succeeded"),
-                            1,
-                            GNUNET_NO);
-  /* validity achieved, remember it! */
-  ve->expecting_pong = GNUNET_NO;
-  ve->valid_until = GNUNET_TIME_relative_to_absolute (HELLO_ADDRESS_EXPIRATION);
-  ve->pong_sig_cache = pong->signature;
-  ve->pong_sig_valid_until = GNUNET_TIME_absolute_ntoh (pong->expiration);
-  ve->latency = GNUNET_TIME_absolute_get_duration (ve->send_time);
-  {
-    if (GNUNET_YES == ve->known_to_ats)
-    {
-      GST_ats_update_delay (ve->address,
-                            GNUNET_TIME_relative_divide (ve->latency, 2));
-    }
-    else
-    {
-      struct GNUNET_ATS_Properties prop;
-
-      memset (&prop, 0, sizeof (prop));
-      prop.scope = ve->network;
-      prop.delay = GNUNET_TIME_relative_divide (ve->latency, 2);
-      ve->known_to_ats = GNUNET_YES;
-      GST_ats_add_address (ve->address, &prop);
-    }
-  }
-  if (validations_running > 0)
-  {
-    validations_running--;
-    GNUNET_STATISTICS_set (GST_stats,
-                           gettext_noop ("# validations running"),
-                           validations_running,
-                           GNUNET_NO);
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Validation finished, %u validation processes running\n",
-                validations_running);
-  }
-  else
-  {
-    GNUNET_break (0);
-  }
-
-  /* Notify about new validity */
-  validation_entry_changed (ve,
-                            GNUNET_TRANSPORT_VS_UPDATE);
-
-  /* build HELLO to store in PEERINFO */
-  ve->copied = GNUNET_NO;
-  hello = GNUNET_HELLO_create (&ve->address->peer.public_key,
-                               &add_valid_peer_address,
-			       ve,
-                               GNUNET_NO);
-  GNUNET_PEERINFO_add_peer (GST_peerinfo,
-			    hello,
-			    NULL,
-			    NULL);
-  GNUNET_free (hello);
+  validation_succeeded (ve,
+                        &pong->signature,
+                        GNUNET_TIME_absolute_ntoh (pong->expiration));
   return GNUNET_OK;
 }
 
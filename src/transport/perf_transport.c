@@ -0,0 +1,794 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file transport/perf_transport.c
+ * @brief benchmark for transport plugins
+ *
+ * Connects two peers using the plugin given by the binary name
+ * (perf_transport_PLUGIN) and runs a fixed set of scenarios, each
+ * sending messages of one size from peer 1 to peer 2 for a fixed
+ * time with a fixed number of messages in flight.  For every
+ * scenario we measure messages/s, goodput and the p50/p99 latency;
+ * the CPU time spent per byte is measured over the whole run,
+ * including the peers.  The results are written as JSON to
+ * perf_transport_PLUGIN.json.
+ */
+#include "platform.h"
+#include "gnunet_transport_service.h"
+#include "gauger.h"
+#include "transport-testing.h"
+
+/**
+ * Message type of benchmark messages
+ */
+#define MTYPE 12346
+
+/**
+ * How long do we send in each scenario?
+ */
+#define SCENARIO_DURATION GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 2)
+
+/**
+ * How often do we check for progress?  Messages still in flight
+ * after a check without progress are counted as lost.
+ */
+#define PROGRESS_INTERVAL GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 500)
+
+/**
+ * Benchmark timeout
+ */
+#define TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+
+/**
+ * How long until we give up on transmitting the message?
+ */
+#define TIMEOUT_TRANSMIT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 60)
+
+/**
+ * How many latency samples do we keep per scenario?
+ */
+#define MAX_SAMPLES (128 * 1024)
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Benchmark message, padded to the size of the scenario.
+ */
+struct PerfMessage
+{
+  /**
+   * Type is #MTYPE.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Index of the scenario the message belongs to.
+   */
+  uint32_t scenario GNUNET_PACKED;
+
+  /**
+   * Number of the message in the scenario.
+   */
+  uint32_t num GNUNET_PACKED;
+
+  /**
+   * When was the message handed to the transport service?
+   */
+  struct GNUNET_TIME_AbsoluteNBO sent;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * A benchmark scenario and its results.
+ */
+struct Scenario
+{
+  /**
+   * Size of the messages.
+   */
+  uint16_t size;
+
+  /**
+   * Number of messages in flight.
+   */
+  unsigned int window;
+
+  /**
+   * Number of messages sent.
+   */
+  unsigned int sent;
+
+  /**
+   * Number of messages received.
+   */
+  unsigned int received;
+
+  /**
+   * Number of messages considered lost.
+   */
+  unsigned int lost;
+
+  /**
+   * When did we start sending?
+   */
+  struct GNUNET_TIME_Absolute start;
+
+  /**
+   * When did we receive the last message?
+   */
+  struct GNUNET_TIME_Absolute last;
+
+  /**
+   * Latency samples in microseconds.
+   */
+  uint64_t *samples;
+
+  /**
+   * Number of latencies measured (may exceed #MAX_SAMPLES).
+   */
+  unsigned int num_samples;
+};
+
+
+/**
+ * Message sizes to benchmark.
+ */
+static const uint16_t sizes[] = { 64, 1024, 16384, 60000 };
+
+/**
+ * Numbers of messages in flight to benchmark.
+ */
+static const unsigned int windows[] = { 1, 16, 256 };
+
+/**
+ * All scenarios, one for each combination of size and window.
+ */
+static struct Scenario scenarios[(sizeof (sizes) / sizeof (sizes[0])) *
+                                 (sizeof (windows) / sizeof (windows[0]))];
+
+/**
+ * Number of #scenarios.
+ */
+static unsigned int num_scenarios;
+
+/**
+ * Index of the scenario currently running.
+ */
+static unsigned int cur;
+
+/**
+ * Number of messages currently in flight.
+ */
+static unsigned int in_flight;
+
+/**
+ * Number of messages received until the last progress check.
+ */
+static unsigned int last_received;
+
+/**
+ * When does sending stop in the current scenario?
+ */
+static struct GNUNET_TIME_Absolute send_end;
+
+/**
+ * Name of the plugin to benchmark
+ */
+static char *test_plugin;
+
+/**
+ * Return value of the benchmark
+ */
+static int ok;
+
+/**
+ * Context of peer 1
+ */
+static struct PeerContext *p1;
+
+/**
+ * Configuration file of peer 1
+ */
+static char *cfg_file_p1;
+
+/**
+ * Context of peer 2
+ */
+static struct PeerContext *p2;
+
+/**
+ * Configuration file of peer 2
+ */
+static char *cfg_file_p2;
+
+/**
+ * Timeout task
+ */
+static struct GNUNET_SCHEDULER_Task *die_task;
+
+/**
+ * Progress check task
+ */
+static struct GNUNET_SCHEDULER_Task *progress_task;
+
+/**
+ * Transport transmit handle used
+ */
+static struct GNUNET_TRANSPORT_TransmitHandle *th;
+
+/**
+ * Transport testing handle
+ */
+static struct GNUNET_TRANSPORT_TESTING_handle *tth;
+
+static GNUNET_TRANSPORT_TESTING_ConnectRequest cc;
+
+
+/**
+ * Compare two latency samples, for qsort().
+ */
+static int
+cmp_sample (const void *a,
+            const void *b)
+{
+  const uint64_t *sa = a;
+  const uint64_t *sb = b;
+
+  if (*sa < *sb)
+    return -1;
+  if (*sa > *sb)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Get a percentile of the latencies of a scenario.
+ *
+ * @param s the scenario, samples must be sorted
+ * @param pct the percentile
+ * @return latency in microseconds
+ */
+static uint64_t
+percentile (const struct Scenario *s,
+            unsigned int pct)
+{
+  unsigned int n;
+
+  n = GNUNET_MIN (s->num_samples, MAX_SAMPLES);
+  if (0 == n)
+    return 0;
+  return s->samples[(n - 1) * pct / 100];
+}
+
+
+/**
+ * Write the results of all scenarios as JSON and report them
+ * to gauger.
+ *
+ * @param cpu_us CPU time used by the benchmark and the peers
+ */
+static void
+report (unsigned long long cpu_us)
+{
+  const struct Scenario *s;
+  unsigned long long total_bytes;
+  unsigned long long usecs;
+  unsigned long long goodput;
+  char *fn;
+  char *value_name;
+  FILE *f;
+  unsigned int i;
+
+  total_bytes = 0;
+  for (i = 0; i < num_scenarios; i++)
+    total_bytes += (unsigned long long) scenarios[i].received * scenarios[i].size;
+  GNUNET_asprintf (&fn,
+                   "perf_transport_%s.json",
+                   test_plugin);
+  f = FOPEN (fn, "w");
+  if (NULL == f)
+  {
+    GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR,
+                              "fopen",
+                              fn);
+    GNUNET_free (fn);
+    ok = 1;
+    return;
+  }
+  FPRINTF (f,
+           "{\"plugin\": \"%s\", \"bytes\": %llu, \"cpu_us\": %llu, \"cpu_ns_per_byte\": %.3f,\n \"scenarios\": [\n",
+           test_plugin,
+           total_bytes,
+           cpu_us,
+           (0 == total_bytes) ? 0.0 : 1000.0 * cpu_us / total_bytes);
+  for (i = 0; i < num_scenarios; i++)
+  {
+    s = &scenarios[i];
+    qsort (s->samples,
+           GNUNET_MIN (s->num_samples, MAX_SAMPLES),
+           sizeof (uint64_t),
+           &cmp_sample);
+    usecs = GNUNET_TIME_absolute_get_difference (s->start,
+                                                 s->last).rel_value_us;
+    if (0 == usecs)
+      usecs = 1;
+    goodput = 1000LL * 1000LL * s->received * s->size / 1024 / usecs;
+    FPRINTF (f,
+             "  {\"size\": %u, \"window\": %u, \"sent\": %u, \"received\": %u, \"lost\": %u, "
+             "\"msgs_per_s\": %llu, \"goodput_kib_s\": %llu, "
+             "\"latency_p50_us\": %llu, \"latency_p99_us\": %llu}%s\n",
+             s->size,
+             s->window,
+             s->sent,
+             s->received,
+             s->lost,
+             1000LL * 1000LL * s->received / usecs,
+             goodput,
+             (unsigned long long) percentile (s, 50),
+             (unsigned long long) percentile (s, 99),
+             (i + 1 < num_scenarios) ? "," : "");
+    FPRINTF (stderr,
+             "%s: %5u bytes, window %3u: %llu KiB/s, p50 %llu us, p99 %llu us\n",
+             test_plugin,
+             s->size,
+             s->window,
+             goodput,
+             (unsigned long long) percentile (s, 50),
+             (unsigned long long) percentile (s, 99));
+    GNUNET_asprintf (&value_name,
+                     "perf_%s_%u_%u",
+                     test_plugin,
+                     s->size,
+                     s->window);
+    GAUGER ("TRANSPORT",
+            value_name,
+            (int) goodput,
+            "kb/s");
+    GNUNET_free (value_name);
+    if (0 == s->received)
+      ok = 1;
+  }
+  FPRINTF (f, "%s", " ]}\n");
+  GNUNET_break (0 == FCLOSE (f));
+  GNUNET_free (fn);
+}
+
+
+/**
+ * Get the CPU time used by us and our (terminated) children.
+ *
+ * @return CPU time in microseconds
+ */
+static unsigned long long
+get_cpu_us ()
+{
+  unsigned long long ret;
+#if HAVE_GETRUSAGE
+  struct rusage ru;
+
+  ret = 0;
+  if (0 == getrusage (RUSAGE_SELF, &ru))
+    ret += ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec
+      + ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+  if (0 == getrusage (RUSAGE_CHILDREN, &ru))
+    ret += ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec
+      + ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+#else
+  ret = 0;
+#endif
+  return ret;
+}
+
+
+static void
+stop_peers ()
+{
+  if (NULL != die_task)
+  {
+    GNUNET_SCHEDULER_cancel (die_task);
+    die_task = NULL;
+  }
+  if (NULL != progress_task)
+  {
+    GNUNET_SCHEDULER_cancel (progress_task);
+    progress_task = NULL;
+  }
+  if (NULL != th)
+  {
+    GNUNET_TRANSPORT_notify_transmit_ready_cancel (th);
+    th = NULL;
+  }
+  if (NULL != cc)
+  {
+    GNUNET_TRANSPORT_TESTING_connect_peers_cancel (tth, cc);
+    cc = NULL;
+  }
+  if (NULL != p1)
+    GNUNET_TRANSPORT_TESTING_stop_peer (tth, p1);
+  if (NULL != p2)
+    GNUNET_TRANSPORT_TESTING_stop_peer (tth, p2);
+  p1 = NULL;
+  p2 = NULL;
+  GNUNET_TRANSPORT_TESTING_done (tth);
+}
+
+
+static void
+end ()
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Stopping peers\n");
+  stop_peers ();
+  ok = 0;
+  /* the peers are gone now, so their CPU time is accounted */
+  report (get_cpu_us ());
+}
+
+
+static void
+end_badly (void *cls,
+           const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  die_task = NULL;
+  GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+              "Fail! Stopping peers\n");
+  stop_peers ();
+  ok = GNUNET_SYSERR;
+}
+
+
+static size_t
+notify_ready (void *cls,
+              size_t size,
+              void *buf);
+
+
+/**
+ * Ask for transmission of the next message of the current
+ * scenario, if the window permits.
+ */
+static void
+transmit ()
+{
+  struct Scenario *s = &scenarios[cur];
+
+  if ( (NULL != th) ||
+       (in_flight >= s->window) ||
+       (0 == GNUNET_TIME_absolute_get_remaining (send_end).rel_value_us) )
+    return;
+  th = GNUNET_TRANSPORT_notify_transmit_ready (p1->th,
+                                               &p2->id,
+                                               s->size,
+                                               TIMEOUT_TRANSMIT,
+                                               &notify_ready,
+                                               NULL);
+}
+
+
+static void
+start_scenario ();
+
+
+/**
+ * Check the progress of the current scenario: finish it once all
+ * messages arrived after sending stopped, and give up on messages
+ * that made no progress since the last check.
+ *
+ * @param cls NULL
+ * @param tc unused
+ */
+static void
+check_progress (void *cls,
+                const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Scenario *s = &scenarios[cur];
+
+  progress_task = NULL;
+  if ( (s->received == last_received) &&
+       (0 != in_flight) )
+  {
+    s->lost += in_flight;
+    in_flight = 0;
+  }
+  last_received = s->received;
+  if ( (0 == GNUNET_TIME_absolute_get_remaining (send_end).rel_value_us) &&
+       (0 == in_flight) )
+  {
+    if (NULL != th)
+    {
+      GNUNET_TRANSPORT_notify_transmit_ready_cancel (th);
+      th = NULL;
+    }
+    cur++;
+    if (cur == num_scenarios)
+    {
+      end ();
+      return;
+    }
+    start_scenario ();
+    return;
+  }
+  transmit ();
+  progress_task = GNUNET_SCHEDULER_add_delayed (PROGRESS_INTERVAL,
+                                                &check_progress,
+                                                NULL);
+}
+
+
+/**
+ * Start the scenario #cur.
+ */
+static void
+start_scenario ()
+{
+  struct Scenario *s = &scenarios[cur];
+
+  GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+              "Sending %u byte messages with %u in flight\n",
+              s->size,
+              s->window);
+  in_flight = 0;
+  last_received = 0;
+  s->start = GNUNET_TIME_absolute_get ();
+  s->last = s->start;
+  send_end = GNUNET_TIME_relative_to_absolute (SCENARIO_DURATION);
+  transmit ();
+  progress_task = GNUNET_SCHEDULER_add_delayed (PROGRESS_INTERVAL,
+                                                &check_progress,
+                                                NULL);
+}
+
+
+static void
+notify_receive (void *cls,
+                const struct GNUNET_PeerIdentity *peer,
+                const struct GNUNET_MessageHeader *message)
+{
+  const struct PerfMessage *pm;
+  struct Scenario *s = &scenarios[cur];
+  uint64_t latency;
+  unsigned int slot;
+
+  if ( (MTYPE != ntohs (message->type)) ||
+       (ntohs (message->size) < sizeof (struct PerfMessage)) )
+    return;
+  pm = (const struct PerfMessage *) message;
+  if ( (cur >= num_scenarios) ||
+       (ntohl (pm->scenario) != cur) )
+    return; /* late message of an earlier scenario */
+  if (ntohs (message->size) != s->size)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Expected message of size %u, got %u bytes\n",
+                s->size,
+                ntohs (message->size));
+    if (NULL != die_task)
+      GNUNET_SCHEDULER_cancel (die_task);
+    die_task = GNUNET_SCHEDULER_add_now (&end_badly, NULL);
+    return;
+  }
+  s->received++;
+  s->last = GNUNET_TIME_absolute_get ();
+  latency = GNUNET_TIME_absolute_get_difference (GNUNET_TIME_absolute_ntoh (pm->sent),
+                                                 s->last).rel_value_us;
+  /* reservoir sampling keeps the percentiles unbiased */
+  if (s->num_samples < MAX_SAMPLES)
+    slot = s->num_samples;
+  else
+    slot = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                     s->num_samples + 1);
+  if (slot < MAX_SAMPLES)
+    s->samples[slot] = latency;
+  s->num_samples++;
+  if (in_flight > 0)
+    in_flight--;
+  transmit ();
+}
+
+
+static size_t
+notify_ready (void *cls,
+              size_t size,
+              void *buf)
+{
+  struct Scenario *s = &scenarios[cur];
+  char *cbuf = buf;
+  struct PerfMessage pm;
+  size_t ret;
+
+  th = NULL;
+  if (NULL == buf)
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Timeout occurred while waiting for transmit_ready\n");
+    if (NULL != die_task)
+      GNUNET_SCHEDULER_cancel (die_task);
+    die_task = GNUNET_SCHEDULER_add_now (&end_badly, NULL);
+    return 0;
+  }
+  GNUNET_assert (size >= s->size);
+  ret = 0;
+  pm.header.size = htons (s->size);
+  pm.header.type = htons (MTYPE);
+  pm.scenario = htonl (cur);
+  pm.sent = GNUNET_TIME_absolute_hton (GNUNET_TIME_absolute_get ());
+  do
+  {
+    pm.num = htonl (s->sent);
+    memcpy (&cbuf[ret], &pm, sizeof (pm));
+    memset (&cbuf[ret + sizeof (pm)], 0, s->size - sizeof (pm));
+    ret += s->size;
+    s->sent++;
+    in_flight++;
+  }
+  while ( (size - ret >= s->size) &&
+          (in_flight < s->window) );
+  transmit ();
+  return ret;
+}
+
+
+static void
+notify_connect (void *cls,
+                const struct GNUNET_PeerIdentity *peer)
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Peer `%4s' connected to us (%p)!\n",
+              GNUNET_i2s (peer), cls);
+}
+
+
+static void
+notify_disconnect (void *cls,
+                   const struct GNUNET_PeerIdentity *peer)
+{
+  GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+              "Peer `%4s' disconnected (%p)!\n",
+              GNUNET_i2s (peer), cls);
+  if (NULL != th)
+    GNUNET_TRANSPORT_notify_transmit_ready_cancel (th);
+  th = NULL;
+}
+
+
+static void
+testing_connect_cb (struct PeerContext *p1,
+                    struct PeerContext *p2,
+                    void *cls)
+{
+  cc = NULL;
+  cur = 0;
+  start_scenario ();
+}
+
+
+static void
+start_cb (struct PeerContext *p,
+          void *cls)
+{
+  static int started;
+
+  started++;
+  if (2 != started)
+    return;
+  cc = GNUNET_TRANSPORT_TESTING_connect_peers (tth, p1, p2,
+                                               &testing_connect_cb,
+                                               NULL);
+}
+
+
+static void
+run (void *cls,
+     char *const *args,
+     const char *cfgfile,
+     const struct GNUNET_CONFIGURATION_Handle *cfg)
+{
+  die_task = GNUNET_SCHEDULER_add_delayed (TIMEOUT,
+                                           &end_badly, NULL);
+  p1 = GNUNET_TRANSPORT_TESTING_start_peer (tth, cfg_file_p1, 1,
+                                            &notify_receive, &notify_connect,
+                                            &notify_disconnect, &start_cb,
+                                            NULL);
+  p2 = GNUNET_TRANSPORT_TESTING_start_peer (tth, cfg_file_p2, 2,
+                                            &notify_receive, &notify_connect,
+                                            &notify_disconnect, &start_cb,
+                                            NULL);
+  if ((NULL == p1) || (NULL == p2))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR,
+                "Fail! Could not start peers!\n");
+    GNUNET_SCHEDULER_cancel (die_task);
+    die_task = GNUNET_SCHEDULER_add_now (&end_badly, NULL);
+  }
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  static char *const argv_new[] = {
+    "perf-transport",
+    "-c",
+    "test_transport_api_data.conf",
+    NULL
+  };
+  static struct GNUNET_GETOPT_CommandLineOption options[] = {
+    GNUNET_GETOPT_OPTION_END
+  };
+  const char *plugin;
+  char *dotexe;
+  unsigned int i;
+  unsigned int j;
+
+  GNUNET_log_setup ("perf-transport",
+                    "WARNING",
+                    NULL);
+  /* binary is called perf_transport_PLUGIN */
+  plugin = strrchr (argv[0], '_');
+  if (NULL == plugin)
+  {
+    GNUNET_break (0);
+    return 1;
+  }
+  test_plugin = GNUNET_strdup (plugin + 1);
+  if (NULL != (dotexe = strstr (test_plugin, ".exe")))
+    dotexe[0] = '\0';
+  GNUNET_asprintf (&cfg_file_p1, "perf_%s_peer1.conf", test_plugin);
+  GNUNET_asprintf (&cfg_file_p2, "perf_%s_peer2.conf", test_plugin);
+  num_scenarios = 0;
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+  {
+#ifndef LINUX
+    /* FreeBSD/OSX etc. Unix DGRAMs do not work
+     * with large messages */
+    if ( (0 == strcmp ("unix", test_plugin)) &&
+         (sizes[i] > 1024) )
+      continue;
+#endif
+    for (j = 0; j < sizeof (windows) / sizeof (windows[0]); j++)
+    {
+      scenarios[num_scenarios].size = sizes[i];
+      scenarios[num_scenarios].window = windows[j];
+      scenarios[num_scenarios].samples
+        = GNUNET_malloc (MAX_SAMPLES * sizeof (uint64_t));
+      num_scenarios++;
+    }
+  }
+  tth = GNUNET_TRANSPORT_TESTING_init ();
+  ok = GNUNET_SYSERR;
+  if (GNUNET_OK !=
+      GNUNET_PROGRAM_run ((sizeof (argv_new) / sizeof (char *)) - 1,
+                          argv_new, "perf-transport",
+                          "nohelp", options,
+                          &run, NULL))
+    ok = 1;
+  for (i = 0; i < num_scenarios; i++)
+    GNUNET_free (scenarios[i].samples);
+  GNUNET_free (cfg_file_p1);
+  GNUNET_free (cfg_file_p2);
+  GNUNET_free (test_plugin);
+  return (0 == ok) ? 0 : 1;
+}
+
+/* end of perf_transport.c */
@@ -487,6 +487,20 @@ notify_session_monitor (struct HTTP_Server_Plugin *plugin,
 }
 
 
+/**
+ * Reschedule the execution of both IPv4 and IPv6 server.
+ *
+ * @param plugin the plugin
+ * @param server which server to schedule v4 or v6?
+ * @param now #GNUNET_YES to schedule execution immediately, #GNUNET_NO to wait
+ * until timeout
+ */
+static void
+server_reschedule (struct HTTP_Server_Plugin *plugin,
+                   struct MHD_Daemon *server,
+                   int now);
+
+
 /**
  * Wake up an MHD connection which was suspended
  *
@@ -506,23 +520,13 @@ server_wake_up (void *cls,
        "Session %p: Waking up PUT handle\n",
        s);
   MHD_resume_connection (s->server_recv->mhd_conn);
+  /* MHD only picks up resumed connections when it runs */
+  server_reschedule (s->plugin,
+                     s->server_recv->mhd_daemon,
+                     GNUNET_YES);
 }
 
 
-/**
- * Reschedule the execution of both IPv4 and IPv6 server.
- *
- * @param plugin the plugin
- * @param server which server to schedule v4 or v6?
- * @param now #GNUNET_YES to schedule execution immediately, #GNUNET_NO to wait
- * until timeout
- */
-static void
-server_reschedule (struct HTTP_Server_Plugin *plugin,
-                   struct MHD_Daemon *server,
-                   int now);
-
-
 /**
  * Deletes the session.  Must not be used afterwards.
  *
@@ -579,9 +583,13 @@ server_delete_session (struct Session *s)
          s, s->server_send,
          GNUNET_i2s (&s->target));
     s->server_send->session = NULL;
+    /* server_send_callback() completes the response, after which
+       the connection can be reused for the requests of the next
+       session instead of requiring a new (TLS) connection */
     MHD_set_connection_option (s->server_send->mhd_conn,
                                MHD_CONNECTION_OPTION_TIMEOUT,
-                               1 /* 0 = no timeout, so this is MIN */);
+                               (unsigned int) (HTTP_SERVER_NOT_VALIDATED_TIMEOUT.rel_value_us
+                                               / 1000LL / 1000LL));
     server_reschedule (plugin, s->server_send->mhd_daemon, GNUNET_YES);
   }
 
@@ -1001,16 +1009,19 @@ server_schedule (struct HTTP_Server_Plugin *plugin,
            last_timeout, timeout);
       last_timeout = timeout;
     }
-    if (timeout <= GNUNET_TIME_UNIT_SECONDS.rel_value_us / 1000LL)
-      tv.rel_value_us = (uint64_t) timeout * 1000LL;
-    else
-      tv = GNUNET_TIME_UNIT_SECONDS;
+    tv = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                        (unsigned long long) timeout);
   }
   else
-    tv = GNUNET_TIME_UNIT_SECONDS;
+  {
+    /* nothing for MHD to time out; we only need to run MHD if
+       its sockets become ready, or if we have something to send
+       (in which case we are rescheduled with @a now) */
+    tv = GNUNET_TIME_UNIT_FOREVER_REL;
+  }
   /* Force immediate run, since we have outbound data to send */
   if (now == GNUNET_YES)
-    tv = GNUNET_TIME_UNIT_MILLISECONDS;
+    tv = GNUNET_TIME_UNIT_ZERO;
   GNUNET_NETWORK_fdset_copy_native (wrs, &rs, max + 1);
   GNUNET_NETWORK_fdset_copy_native (wws, &ws, max + 1);
 
@@ -1555,8 +1566,9 @@ server_send_callback (void *cls,
 
   if (NULL == s)
   {
-    /* session is disconnecting */
-    return 0;
+    /* session is disconnecting, complete the response so that
+       the connection stays usable */
+    return MHD_CONTENT_READER_END_OF_STREAM;
   }
 
   sc = s->server_send;
@@ -2184,6 +2196,7 @@ run_mhd_start_daemon (struct HTTP_Server_Plugin *plugin,
 {
   struct MHD_Daemon *server;
   unsigned int timeout;
+  int epoll;
 
 #if MHD_VERSION >= 0x00090E00
   timeout = HTTP_SERVER_NOT_VALIDATED_TIMEOUT.rel_value_us / 1000LL / 1000LL;
@@ -2196,6 +2209,14 @@ run_mhd_start_daemon (struct HTTP_Server_Plugin *plugin,
        "MHD cannot set timeout per connection! Default time out %u sec.\n",
        timeout);
 #endif
+#if LINUX
+  /* With epoll, MHD gives us a single file descriptor to wait for,
+     instead of select sets that have to be rebuilt for every run */
+  epoll = MHD_USE_EPOLL_LINUX_ONLY;
+#else
+  epoll = MHD_NO_FLAG;
+#endif
+retry:
   server = MHD_start_daemon (
 #if VERBOSE_SERVER
                              MHD_USE_DEBUG |
@@ -2204,6 +2225,7 @@ run_mhd_start_daemon (struct HTTP_Server_Plugin *plugin,
                              MHD_USE_SSL |
 #endif
                              MHD_USE_SUSPEND_RESUME |
+                             epoll |
                              v6,
                              plugin->port,
                              &server_accept_cb, plugin,
@@ -2230,6 +2252,14 @@ run_mhd_start_daemon (struct HTTP_Server_Plugin *plugin,
                              MHD_OPTION_EXTERNAL_LOGGER,
                              &server_log, NULL,
                              MHD_OPTION_END);
+  if ( (NULL == server) &&
+       (MHD_NO_FLAG != epoll) )
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Failed to start MHD with epoll, trying again without\n");
+    epoll = MHD_NO_FLAG;
+    goto retry;
+  }
 #ifdef TCP_STEALTH
   if ( (NULL != server) &&
        (0 != (plugin->options & HTTP_OPTIONS_TCP_STEALTH)) )
@@ -45,6 +45,20 @@
  */
 #define NAT_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 10)
 
+/**
+ * How many bytes of pending messages do we pass to the
+ * connection in one (vectored) write at most?
+ */
+#define COALESCE_MAX_BYTES (64 * 1024)
+
+/**
+ * How many bytes that cannot be sent yet do we allow the kernel to
+ * buffer per connection (TCP_NOTSENT_LOWAT)?  Everything beyond
+ * stays in our queue, where messages with higher priority can still
+ * overtake it.
+ */
+#define NOTSENT_LOWAT (16 * 1024)
+
 GNUNET_NETWORK_STRUCT_BEGIN
 
 
@@ -243,6 +257,12 @@ struct PendingMessage
    */
   size_t message_size;
 
+  /**
+   * Priority of the message, messages with a higher priority
+   * are transmitted first.
+   */
+  unsigned int priority;
+
 };
 
 /**
@@ -283,6 +303,20 @@ struct Session
    */
   struct PendingMessage *pending_messages_tail;
 
+  /**
+   * Messages passed to the connection with
+   * #GNUNET_SERVER_transmit_messages() and not yet
+   * transmitted completely.
+   */
+  struct PendingMessage *transmit_head;
+
+  /**
+   * Messages passed to the connection with
+   * #GNUNET_SERVER_transmit_messages() and not yet
+   * transmitted completely.
+   */
+  struct PendingMessage *transmit_tail;
+
   /**
    * Handle for pending transmission request.
    */
@@ -873,6 +907,15 @@ tcp_plugin_disconnect_session (void *cls,
     GNUNET_SERVER_notify_transmit_ready_cancel (session->transmit_handle);
     session->transmit_handle = NULL;
   }
+  while (NULL != (pm = session->transmit_tail))
+  {
+    GNUNET_CONTAINER_DLL_remove (session->transmit_head,
+                                 session->transmit_tail,
+                                 pm);
+    GNUNET_CONTAINER_DLL_insert (session->pending_messages_head,
+                                 session->pending_messages_tail,
+                                 pm);
+  }
   session->plugin->env->session_end (session->plugin->env->cls,
                                      session->address,
                                      session);
@@ -1046,6 +1089,8 @@ create_session (struct Plugin *plugin,
     session->client = client;
     GNUNET_SERVER_client_set_user_context (client,
                                            session);
+    (void) GNUNET_SERVER_client_set_notsent_lowat (client,
+                                                   NOTSENT_LOWAT);
   }
   session->address = GNUNET_HELLO_address_copy (address);
   session->target = address->peer;
@@ -1059,6 +1104,7 @@ create_session (struct Plugin *plugin,
           &plugin->my_welcome,
           sizeof(struct WelcomeMessage));
   pm->timeout = GNUNET_TIME_UNIT_FOREVER_ABS;
+  pm->priority = UINT_MAX;
   GNUNET_STATISTICS_update (plugin->env->stats,
                             gettext_noop ("# bytes currently in TCP buffers"),
 			    pm->message_size,
@@ -1105,6 +1151,61 @@ static void
 process_pending_messages (struct Session *session);
 
 
+/**
+ * Complete the transmission of the given messages: update the
+ * statistics, ask for the next transmission and call the
+ * continuations.
+ *
+ * @param session session the messages were transmitted on
+ * @param hd head of the DLL of transmitted messages
+ * @param tl tail of the DLL of transmitted messages
+ * @param ret total number of bytes transmitted
+ */
+static void
+finish_transmission (struct Session *session,
+                     struct PendingMessage *hd,
+                     struct PendingMessage *tl,
+                     size_t ret)
+{
+  struct Plugin *plugin = session->plugin;
+  struct GNUNET_PeerIdentity pid;
+  struct PendingMessage *pos;
+
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  /* schedule 'continuation' before callbacks so that callbacks that
+   * cancel everything don't cause us to use a session that no longer
+   * exists... */
+  process_pending_messages (session);
+  session->last_activity = GNUNET_TIME_absolute_get ();
+  pid = session->target;
+  /* we'll now call callbacks that may cancel the session; hence
+   * we should not use 'session' after this point */
+  while (NULL != (pos = hd))
+  {
+    GNUNET_CONTAINER_DLL_remove (hd, tl, pos);
+    if (NULL != pos->transmit_cont)
+      pos->transmit_cont (pos->transmit_cont_cls,
+                          &pid,
+                          GNUNET_OK,
+                          pos->message_size,
+                          pos->message_size); /* FIXME: include TCP overhead */
+    GNUNET_free (pos);
+  }
+  GNUNET_assert (NULL == hd);
+  GNUNET_assert (NULL == tl);
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            gettext_noop ("# bytes currently in TCP buffers"),
+                            - (int64_t) ret,
+                            GNUNET_NO);
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            gettext_noop ("# bytes transmitted via TCP"),
+                            ret,
+                            GNUNET_NO);
+}
+
+
 /**
  * Function called to notify a client about the socket
  * being ready to queue more data.  "buf" will be
@@ -1232,39 +1333,108 @@ do_transmit (void *cls,
                                       tl,
                                       pos);
   }
-  notify_session_monitor (session->plugin,
-                          session,
-                          GNUNET_TRANSPORT_SS_UPDATE);
-  /* schedule 'continuation' before callbacks so that callbacks that
-   * cancel everything don't cause us to use a session that no longer
-   * exists... */
-  process_pending_messages (session);
-  session->last_activity = GNUNET_TIME_absolute_get ();
-  pid = session->target;
-  /* we'll now call callbacks that may cancel the session; hence
-   * we should not use 'session' after this point */
-  while (NULL != (pos = hd))
+  finish_transmission (session,
+                       hd,
+                       tl,
+                       ret);
+  return ret;
+}
+
+
+/**
+ * Function called once the messages we passed to
+ * #GNUNET_SERVER_transmit_messages() were transmitted, or
+ * if the transmission failed.
+ *
+ * @param cls the `struct Session`
+ * @param result #GNUNET_OK if all messages were transmitted,
+ *        #GNUNET_SYSERR if we timed out before we could start
+ *        or if the connection failed
+ */
+static void
+transmit_done (void *cls,
+               int result)
+{
+  struct Session *session = cls;
+  struct PendingMessage *pos;
+  struct PendingMessage *hd;
+  struct PendingMessage *tl;
+  size_t ret;
+
+  session->transmit_handle = NULL;
+  if (GNUNET_OK != result)
   {
-    GNUNET_CONTAINER_DLL_remove (hd, tl, pos);
-    if (NULL != pos->transmit_cont)
-      pos->transmit_cont (pos->transmit_cont_cls,
-                          &pid,
-                          GNUNET_OK,
-                          pos->message_size,
-                          pos->message_size); /* FIXME: include TCP overhead */
-    GNUNET_free (pos);
+    /* put the messages back, so that they time out (or are
+       failed upon disconnect) like everything else */
+    while (NULL != (pos = session->transmit_tail))
+    {
+      GNUNET_CONTAINER_DLL_remove (session->transmit_head,
+                                   session->transmit_tail,
+                                   pos);
+      GNUNET_CONTAINER_DLL_insert (session->pending_messages_head,
+                                   session->pending_messages_tail,
+                                   pos);
+    }
+    (void) do_transmit (session,
+                        0,
+                        NULL);
+    return;
   }
-  GNUNET_assert (NULL == hd);
-  GNUNET_assert (NULL == tl);
-  GNUNET_STATISTICS_update (plugin->env->stats,
-                            gettext_noop ("# bytes currently in TCP buffers"),
-                            - (int64_t) ret,
-                            GNUNET_NO);
-  GNUNET_STATISTICS_update (plugin->env->stats,
-                            gettext_noop ("# bytes transmitted via TCP"),
-                            ret,
-                            GNUNET_NO);
-  return ret;
+  ret = 0;
+  hd = session->transmit_head;
+  tl = session->transmit_tail;
+  session->transmit_head = NULL;
+  session->transmit_tail = NULL;
+  for (pos = hd; NULL != pos; pos = pos->next)
+  {
+    GNUNET_assert (0 < session->msgs_in_queue);
+    session->msgs_in_queue--;
+    GNUNET_assert (pos->message_size <= session->bytes_in_queue);
+    session->bytes_in_queue -= pos->message_size;
+    ret += pos->message_size;
+  }
+  finish_transmission (session,
+                       hd,
+                       tl,
+                       ret);
+}
+
+
+/**
+ * Find the messages contained in the buffer of a pending message.
+ *
+ * @param pm pending message to split
+ * @param msgs where to store the messages
+ * @param max number of entries available in @a msgs
+ * @return number of messages stored in @a msgs, 0 if the
+ *         buffer is malformed or contains more than @a max messages
+ */
+static unsigned int
+split_pending_message (const struct PendingMessage *pm,
+                       const struct GNUNET_MessageHeader **msgs,
+                       unsigned int max)
+{
+  const struct GNUNET_MessageHeader *hdr;
+  size_t off;
+  uint16_t msize;
+  unsigned int n;
+
+  n = 0;
+  off = 0;
+  while (off < pm->message_size)
+  {
+    if ( (n == max) ||
+         (pm->message_size - off < sizeof (struct GNUNET_MessageHeader)) )
+      return 0;
+    hdr = (const struct GNUNET_MessageHeader *) &pm->msg[off];
+    msize = ntohs (hdr->size);
+    if ( (msize < sizeof (struct GNUNET_MessageHeader)) ||
+         (msize > pm->message_size - off) )
+      return 0;
+    msgs[n++] = hdr;
+    off += msize;
+  }
+  return n;
 }
 
 
@@ -1272,19 +1442,72 @@ do_transmit (void *cls,
  * If we have pending messages, ask the server to
  * transmit them (schedule the respective tasks, etc.)
  *
+ * As many messages as fit into one vectored write are passed to
+ * the connection without copying; we only fall back to copying
+ * them via #do_transmit() if the first message cannot be passed
+ * this way.
+ *
  * @param session for which session should we do this
  */
 static void
 process_pending_messages (struct Session *session)
 {
+  const struct GNUNET_MessageHeader *msgs[GNUNET_CONNECTION_MAX_MESSAGES];
   struct PendingMessage *pm;
+  struct PendingMessage *last;
+  unsigned int count;
+  unsigned int n;
+  size_t bytes;
 
   GNUNET_assert (NULL != session->client);
   if (NULL != session->transmit_handle)
     return;
   if (NULL == (pm = session->pending_messages_head))
     return;
-
+  GNUNET_assert (NULL == session->transmit_head);
+  count = 0;
+  bytes = 0;
+  last = NULL;
+  for (pm = session->pending_messages_head; NULL != pm; pm = pm->next)
+  {
+    if ( (NULL != last) &&
+         (bytes + pm->message_size > COALESCE_MAX_BYTES) )
+      break;
+    n = split_pending_message (pm,
+                               &msgs[count],
+                               GNUNET_CONNECTION_MAX_MESSAGES - count);
+    if (0 == n)
+      break;
+    count += n;
+    bytes += pm->message_size;
+    last = pm;
+  }
+  pm = session->pending_messages_head;
+  if (0 < count)
+    session->transmit_handle
+      = GNUNET_SERVER_transmit_messages (session->client,
+                                         msgs,
+                                         count,
+                                         GNUNET_TIME_absolute_get_remaining (pm->timeout),
+                                         &transmit_done,
+                                         session);
+  if (NULL != session->transmit_handle)
+  {
+    /* move the messages out of the queue, so that nothing
+       can be inserted in front of them any more */
+    do
+    {
+      pm = session->pending_messages_head;
+      GNUNET_CONTAINER_DLL_remove (session->pending_messages_head,
+                                   session->pending_messages_tail,
+                                   pm);
+      GNUNET_CONTAINER_DLL_insert_tail (session->transmit_head,
+                                        session->transmit_tail,
+                                        pm);
+    }
+    while (pm != last);
+    return;
+  }
   session->transmit_handle
     = GNUNET_SERVER_notify_transmit_ready (session->client,
                                            pm->message_size,
@@ -1294,6 +1517,31 @@ process_pending_messages (struct Session *session)
 }
 
 
+/**
+ * Add a message to the queue of a session, behind all messages
+ * of the same or a higher priority.  Messages that were already
+ * handed to the connection are not part of the queue, so nothing
+ * can overtake (or split) a message that is being transmitted.
+ *
+ * @param session session to queue the message for
+ * @param pm message to queue
+ */
+static void
+insert_pending_message (struct Session *session,
+                        struct PendingMessage *pm)
+{
+  struct PendingMessage *pos;
+
+  for (pos = session->pending_messages_tail; NULL != pos; pos = pos->prev)
+    if (pos->priority >= pm->priority)
+      break;
+  GNUNET_CONTAINER_DLL_insert_after (session->pending_messages_head,
+                                     session->pending_messages_tail,
+                                     pos,
+                                     pm);
+}
+
+
 /**
  * Function that can be used by the transport service to transmit
  * a message using the plugin.   Note that in the case of a
@@ -1342,6 +1590,7 @@ tcp_plugin_send (void *cls,
   pm->timeout = GNUNET_TIME_relative_to_absolute (to);
   pm->transmit_cont = cont;
   pm->transmit_cont_cls = cont_cls;
+  pm->priority = priority;
 
   LOG(GNUNET_ERROR_TYPE_DEBUG,
       "Asked to transmit %u bytes to `%s', added message to list.\n",
@@ -1361,10 +1610,8 @@ tcp_plugin_send (void *cls,
                               msgbuf_size,
                               GNUNET_NO);
 
-    /* append pm to pending_messages list */
-    GNUNET_CONTAINER_DLL_insert_tail (session->pending_messages_head,
-                                      session->pending_messages_tail,
-                                      pm);
+    insert_pending_message (session,
+                            pm);
     notify_session_monitor (session->plugin,
                             session,
                             GNUNET_TRANSPORT_SS_UPDATE);
@@ -1384,10 +1631,8 @@ tcp_plugin_send (void *cls,
     GNUNET_STATISTICS_update (plugin->env->stats,
                               gettext_noop ("# bytes currently in TCP buffers"), msgbuf_size,
                               GNUNET_NO);
-    /* append pm to pending_messages list */
-    GNUNET_CONTAINER_DLL_insert_tail (session->pending_messages_head,
-                                      session->pending_messages_tail,
-                                      pm);
+    insert_pending_message (session,
+                            pm);
     session->msgs_in_queue++;
     session->bytes_in_queue += pm->message_size;
     notify_session_monitor (session->plugin,
@@ -2255,6 +2500,8 @@ handle_tcp_nat_probe (void *cls,
   GNUNET_free (vaddr);
   GNUNET_break (NULL == session->client);
   session->client = client;
+  (void) GNUNET_SERVER_client_set_notsent_lowat (client,
+                                                 NOTSENT_LOWAT);
   GNUNET_STATISTICS_update (plugin->env->stats,
 			    gettext_noop ("# TCP sessions active"),
 			    1,
@@ -48,24 +48,68 @@
 #define UDP_SESSION_TIME_OUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS, 60)
 
 /**
- * Number of messages we can defragment in parallel.  We only really
- * defragment 1 message at a time, but if messages get re-ordered, we
- * may want to keep knowledge about the previous message to avoid
- * discarding the current message in favor of a single fragment of a
- * previous message.  3 should be good since we don't expect massive
- * message reorderings with UDP.
+ * Number of independent streams per session.  Each stream has at
+ * most one fragmented message in transmission, so losses on a
+ * stream carrying bulk data do not delay fragmented messages of
+ * other streams.  The transmission priority selects the stream.
  */
-#define UDP_MAX_MESSAGES_IN_DEFRAG 3
+#define UDP_NUM_STREAMS 3
+
+/**
+ * Number of messages we can defragment in parallel.  The sender
+ * fragments one message per stream at a time, but if messages get
+ * re-ordered, we may want to keep knowledge about the previous
+ * message to avoid discarding the current message in favor of a
+ * single fragment of a previous message.  One extra should be good
+ * since we don't expect massive message reorderings with UDP.
+ */
+#define UDP_MAX_MESSAGES_IN_DEFRAG (UDP_NUM_STREAMS + 1)
+
+/**
+ * For how long do we keep the congestion control state of a peer
+ * after its last session ended, so that a new session can resume
+ * with it instead of starting from scratch?
+ */
+#define UDP_RESUMPTION_TIMEOUT GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES, 5)
+
+/**
+ * For how many peers do we keep congestion control state after
+ * their sessions ended?
+ */
+#define UDP_MAX_RESUMABLE_PEERS 128
 
 /**
  * We keep a defragmentation queue per sender address.  How many
  * sender addresses do we support at the same time? Memory consumption
  * is roughly a factor of 32k * #UDP_MAX_MESSAGES_IN_DEFRAG times this
- * value. (So 128 corresponds to 12 MB and should suffice for
+ * value. (So 128 corresponds to 16 MB and should suffice for
  * connecting to roughly 128 peers via UDP).
  */
 #define UDP_MAX_SENDER_ADDRESSES_WITH_DEFRAG 128
 
+/**
+ * Maximum number of datagrams we receive or transmit per socket
+ * and select wakeup.
+ */
+#define UDP_IO_BATCH 16
+
+/**
+ * Size of the buffer we receive a datagram into.
+ */
+#define UDP_READ_BUFFER_SIZE 65536
+
+/**
+ * Maximum number of datagrams we coalesce into a single
+ * segmentation offload send (kernel limit).
+ */
+#define UDP_GSO_MAX_SEGMENTS 64
+
+/**
+ * Maximum number of bytes we coalesce into a single segmentation
+ * offload send (must fit into one IP datagram).
+ */
+#define UDP_GSO_MAX_BYTES 65000
+
 
 /**
  * UDP Message-Packet header (after defragmentation).
@@ -164,9 +208,16 @@ struct Session
   struct Plugin *plugin;
 
   /**
-   * Context for dealing with fragments.
+   * Fragmented messages we are transmitting, one per stream
+   * (NULL if the stream is idle).
    */
-  struct UDP_FragmentationContext *frag_ctx;
+  struct UDP_FragmentationContext *frag_ctx[UDP_NUM_STREAMS];
+
+  /**
+   * Congestion control for the fragments we send to the other peer,
+   * created with the first fragmented message.
+   */
+  struct GNUNET_FRAGMENT_Congestion *cc;
 
   /**
    * Desired delay for next sending we send to other peer
@@ -344,6 +395,35 @@ struct UDP_FragmentationContext
    */
   size_t on_wire_size;
 
+  /**
+   * Stream of the session the message is transmitted on.
+   */
+  unsigned int stream;
+
+};
+
+
+/**
+ * Congestion control state of a peer kept after its last session
+ * ended, to be resumed by the next session.
+ */
+struct ResumptionEntry
+{
+  /**
+   * Peer the state is for.
+   */
+  struct GNUNET_PeerIdentity peer;
+
+  /**
+   * Congestion control state.
+   */
+  struct GNUNET_FRAGMENT_Congestion *cc;
+
+  /**
+   * Node in the heap of entries, by expiration time.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
 };
 
 
@@ -566,6 +646,109 @@ udp_plugin_setup_monitor (void *cls,
 /* ****************** Little Helpers ****************** */
 
 
+/**
+ * Forget the resumption state kept for a peer.
+ *
+ * @param plugin the UDP plugin
+ * @param re entry to free
+ */
+static void
+free_resumption_entry (struct Plugin *plugin,
+                       struct ResumptionEntry *re)
+{
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multipeermap_remove (plugin->resumption,
+                                                       &re->peer,
+                                                       re));
+  GNUNET_CONTAINER_heap_remove_node (re->hn);
+  GNUNET_FRAGMENT_congestion_destroy (re->cc);
+  GNUNET_free (re);
+}
+
+
+/**
+ * Keep the congestion control state of a session that ended, so
+ * that the next session with the same peer can resume with the
+ * known round-trip time and window instead of starting over.
+ *
+ * @param plugin the UDP plugin
+ * @param peer peer the state is for
+ * @param cc congestion control state, ownership passes to the plugin
+ */
+static void
+save_congestion (struct Plugin *plugin,
+                 const struct GNUNET_PeerIdentity *peer,
+                 struct GNUNET_FRAGMENT_Congestion *cc)
+{
+  struct ResumptionEntry *re;
+  struct GNUNET_TIME_Absolute now;
+
+  if (NULL != (re = GNUNET_CONTAINER_multipeermap_get (plugin->resumption,
+                                                       peer)))
+    free_resumption_entry (plugin,
+                           re);
+  now = GNUNET_TIME_absolute_get ();
+  while ( (NULL != (re = GNUNET_CONTAINER_heap_peek (plugin->resumption_heap))) &&
+          ( (GNUNET_CONTAINER_heap_get_size (plugin->resumption_heap) >= UDP_MAX_RESUMABLE_PEERS) ||
+            (GNUNET_CONTAINER_heap_node_get_cost (re->hn) <= now.abs_value_us) ) )
+    free_resumption_entry (plugin,
+                           re);
+  re = GNUNET_new (struct ResumptionEntry);
+  re->peer = *peer;
+  re->cc = cc;
+  re->hn = GNUNET_CONTAINER_heap_insert (plugin->resumption_heap,
+                                         re,
+                                         GNUNET_TIME_relative_to_absolute (UDP_RESUMPTION_TIMEOUT).abs_value_us);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONTAINER_multipeermap_put (plugin->resumption,
+                                                    &re->peer,
+                                                    re,
+                                                    GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+}
+
+
+/**
+ * Obtain congestion control state for a new session with a peer,
+ * resuming the state of an earlier session if we still have it.
+ *
+ * @param plugin the UDP plugin
+ * @param peer peer to get the state for
+ * @return congestion control state, owned by the caller
+ */
+static struct GNUNET_FRAGMENT_Congestion *
+resume_congestion (struct Plugin *plugin,
+                   const struct GNUNET_PeerIdentity *peer)
+{
+  struct ResumptionEntry *re;
+  struct GNUNET_FRAGMENT_Congestion *cc;
+
+  re = GNUNET_CONTAINER_multipeermap_get (plugin->resumption,
+                                          peer);
+  if ( (NULL == re) ||
+       (GNUNET_CONTAINER_heap_node_get_cost (re->hn) <=
+        GNUNET_TIME_absolute_get ().abs_value_us) )
+  {
+    if (NULL != re)
+      free_resumption_entry (plugin,
+                             re);
+    return GNUNET_FRAGMENT_congestion_create ();
+  }
+  cc = re->cc;
+  re->cc = NULL;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multipeermap_remove (plugin->resumption,
+                                                       &re->peer,
+                                                       re));
+  GNUNET_CONTAINER_heap_remove_node (re->hn);
+  GNUNET_free (re);
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# UDP, congestion state resumed",
+                            1,
+                            GNUNET_NO);
+  return cc;
+}
+
+
 /**
  * Function to free last resources associated with a session.
  *
@@ -574,18 +757,41 @@ udp_plugin_setup_monitor (void *cls,
 static void
 free_session (struct Session *s)
 {
+  struct GNUNET_FRAGMENT_CongestionInfo info;
+  unsigned int i;
+
   if (NULL != s->address)
   {
     GNUNET_HELLO_address_free (s->address);
     s->address = NULL;
   }
-  if (NULL != s->frag_ctx)
+  for (i = 0; i < UDP_NUM_STREAMS; i++)
   {
-    GNUNET_FRAGMENT_context_destroy (s->frag_ctx->frag,
+    if (NULL == s->frag_ctx[i])
+      continue;
+    GNUNET_FRAGMENT_context_destroy (s->frag_ctx[i]->frag,
                                      NULL,
                                      NULL);
-    GNUNET_free (s->frag_ctx);
-    s->frag_ctx = NULL;
+    GNUNET_free (s->frag_ctx[i]);
+    s->frag_ctx[i] = NULL;
+  }
+  if (NULL != s->cc)
+  {
+    GNUNET_FRAGMENT_congestion_get_info (s->cc,
+                                         &info);
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Fragments to `%s': %llu sent, %llu retransmitted, %llu lost, final window %u, RTT %s\n",
+         GNUNET_i2s (&s->target),
+         (unsigned long long) info.fragments_sent,
+         (unsigned long long) info.fragments_retransmitted,
+         (unsigned long long) info.fragments_lost,
+         info.cwnd,
+         GNUNET_STRINGS_relative_time_to_string (info.srtt,
+                                                 GNUNET_YES));
+    save_congestion (s->plugin,
+                     &s->target,
+                     s->cc);
+    s->cc = NULL;
   }
   GNUNET_free (s);
 }
@@ -1538,7 +1744,7 @@ fragmented_message_done (struct UDP_FragmentationContext *frag_ctx,
     frag_ctx->cont (frag_ctx->cont_cls,
                     &s->target,
                     result,
-                    s->frag_ctx->payload_size,
+                    frag_ctx->payload_size,
                     frag_ctx->on_wire_size);
   GNUNET_STATISTICS_update (plugin->env->stats,
                             "# UDP, fragmented messages active",
@@ -1553,7 +1759,7 @@ fragmented_message_done (struct UDP_FragmentationContext *frag_ctx,
                               GNUNET_NO);
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, fragmented msgs, bytes payload, sent, success",
-                              s->frag_ctx->payload_size,
+                              frag_ctx->payload_size,
                               GNUNET_NO);
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, fragmented msgs, bytes overhead, sent, success",
@@ -1565,7 +1771,7 @@ fragmented_message_done (struct UDP_FragmentationContext *frag_ctx,
                               GNUNET_NO);
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, total, bytes payload, sent",
-                              s->frag_ctx->payload_size,
+                              frag_ctx->payload_size,
                               GNUNET_NO);
   }
   else
@@ -1576,7 +1782,7 @@ fragmented_message_done (struct UDP_FragmentationContext *frag_ctx,
                               GNUNET_NO);
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, fragmented msgs, bytes payload, sent, failure",
-                              s->frag_ctx->payload_size,
+                              frag_ctx->payload_size,
                               GNUNET_NO);
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, fragmented msgs, bytes payload, sent, failure",
@@ -1628,7 +1834,7 @@ fragmented_message_done (struct UDP_FragmentationContext *frag_ctx,
   GNUNET_FRAGMENT_context_destroy (frag_ctx->frag,
                                    &s->last_expected_msg_delay,
                                    &s->last_expected_ack_delay);
-  s->frag_ctx = NULL;
+  s->frag_ctx[frag_ctx->stream] = NULL;
   GNUNET_free (frag_ctx);
 }
 
@@ -1830,6 +2036,7 @@ udp_plugin_send (void *cls,
   struct UDP_FragmentationContext *frag_ctx;
   struct UDP_MessageWrapper *udpw;
   struct UDPMessage *udp;
+  unsigned int stream;
   char mbuf[udpmlen] GNUNET_ALIGN;
 
   if ( (sizeof(struct IPv6UdpAddress) == s->address->address_length) &&
@@ -1906,8 +2113,10 @@ udp_plugin_send (void *cls,
   }
   else
   {
-    /* fragmented message */
-    if (NULL != s->frag_ctx)
+    /* fragmented message, on the stream for its priority */
+    stream = GNUNET_MIN (priority,
+                         UDP_NUM_STREAMS - 1);
+    if (NULL != s->frag_ctx[stream])
       return GNUNET_SYSERR;
     memcpy (&udp[1],
             msgbuf,
@@ -1920,15 +2129,20 @@ udp_plugin_send (void *cls,
     frag_ctx->timeout = GNUNET_TIME_relative_to_absolute (to);
     frag_ctx->payload_size = msgbuf_size; /* unfragmented message size without UDP overhead */
     frag_ctx->on_wire_size = 0; /* bytes with UDP and fragmentation overhead */
-    frag_ctx->frag = GNUNET_FRAGMENT_context_create (plugin->env->stats,
-                                                     UDP_MTU,
-                                                     &plugin->tracker,
-                                                     s->last_expected_msg_delay,
-                                                     s->last_expected_ack_delay,
-                                                     &udp->header,
-                                                     &enqueue_fragment,
-                                                     frag_ctx);
-    s->frag_ctx = frag_ctx;
+    frag_ctx->stream = stream;
+    if (NULL == s->cc)
+      s->cc = resume_congestion (plugin,
+                                 &s->target);
+    frag_ctx->frag = GNUNET_FRAGMENT_context_create_cc (plugin->env->stats,
+                                                        UDP_MTU,
+                                                        &plugin->tracker,
+                                                        s->cc,
+                                                        &udp->header,
+                                                        &enqueue_fragment,
+                                                        frag_ctx);
+    GNUNET_FRAGMENT_context_set_priority (frag_ctx->frag,
+                                          stream);
+    s->frag_ctx[stream] = frag_ctx;
     GNUNET_STATISTICS_update (plugin->env->stats,
                               "# UDP, fragmented messages active",
                               1,
@@ -1972,6 +2186,8 @@ read_process_ack (struct Plugin *plugin,
   struct GNUNET_HELLO_Address *address;
   struct Session *s;
   struct GNUNET_TIME_Relative flow_delay;
+  unsigned int i;
+  int ret;
 
   if (ntohs (msg->size)
       < sizeof(struct UDP_ACK_Message) + sizeof(struct GNUNET_MessageHeader))
@@ -2003,7 +2219,10 @@ read_process_ack (struct Plugin *plugin,
     GNUNET_HELLO_address_free (address);
     return;
   }
-  if (NULL == s->frag_ctx)
+  for (i = 0; i < UDP_NUM_STREAMS; i++)
+    if (NULL != s->frag_ctx[i])
+      break;
+  if (UDP_NUM_STREAMS == i)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG | GNUNET_ERROR_TYPE_BULK,
          "Fragmentation context of address %s for ACK (%s) not found\n",
@@ -2024,10 +2243,18 @@ read_process_ack (struct Plugin *plugin,
        GNUNET_i2s (&udp_ack->sender));
   s->flow_delay_from_other_peer = GNUNET_TIME_relative_to_absolute (flow_delay);
 
-
-  if (GNUNET_OK !=
-      GNUNET_FRAGMENT_process_ack (s->frag_ctx->frag,
-                                   ack))
+  /* find the stream the ACK is for */
+  ret = GNUNET_SYSERR;
+  for (i = 0; i < UDP_NUM_STREAMS; i++)
+  {
+    if (NULL == s->frag_ctx[i])
+      continue;
+    ret = GNUNET_FRAGMENT_process_ack (s->frag_ctx[i]->frag,
+                                       ack);
+    if (GNUNET_SYSERR != ret)
+      break;
+  }
+  if (GNUNET_OK != ret)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "UDP processes %u-byte acknowledgement from `%s' at `%s'\n",
@@ -2048,7 +2275,7 @@ read_process_ack (struct Plugin *plugin,
                               udp_addr_len));
 
   /* Remove fragmented message after successful sending */
-  fragmented_message_done (s->frag_ctx,
+  fragmented_message_done (s->frag_ctx[i],
                            GNUNET_OK);
 }
 
@@ -2160,6 +2387,7 @@ udp_disconnect_session (void *cls,
   struct UDP_MessageWrapper *udpw;
   struct UDP_MessageWrapper *next;
   struct FindReceiveContext frc;
+  unsigned int i;
 
   GNUNET_assert (GNUNET_YES != s->in_destroy);
   LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -2174,10 +2402,12 @@ udp_disconnect_session (void *cls,
     GNUNET_SCHEDULER_cancel (s->timeout_task);
     s->timeout_task = NULL;
   }
-  if (NULL != s->frag_ctx)
+  for (i = 0; i < UDP_NUM_STREAMS; i++)
   {
+    if (NULL == s->frag_ctx[i])
+      continue;
     /* Remove fragmented message due to disconnect */
-    fragmented_message_done (s->frag_ctx,
+    fragmented_message_done (s->frag_ctx[i],
                              GNUNET_SYSERR);
   }
   GNUNET_assert (GNUNET_YES ==
@@ -2231,19 +2461,21 @@ udp_disconnect_session (void *cls,
       GNUNET_free (udpw);
     }
   }
-  if ( (NULL != s->frag_ctx) &&
-       (NULL != s->frag_ctx->cont) )
+  for (i = 0; i < UDP_NUM_STREAMS; i++)
   {
+    if ( (NULL == s->frag_ctx[i]) ||
+         (NULL == s->frag_ctx[i]->cont) )
+      continue;
     /* The 'frag_ctx' itself will be freed in #free_session() a bit
        later, as it might be in use right now */
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Calling continuation for fragemented message to `%s' with result SYSERR\n",
          GNUNET_i2s (&s->target));
-    s->frag_ctx->cont (s->frag_ctx->cont_cls,
-                       &s->target,
-                       GNUNET_SYSERR,
-                       s->frag_ctx->payload_size,
-                       s->frag_ctx->on_wire_size);
+    s->frag_ctx[i]->cont (s->frag_ctx[i]->cont_cls,
+                          &s->target,
+                          GNUNET_SYSERR,
+                          s->frag_ctx[i]->payload_size,
+                          s->frag_ctx[i]->on_wire_size);
   }
   notify_session_monitor (s->plugin,
                           s,
@@ -2798,64 +3030,30 @@ read_process_fragment (struct Plugin *plugin,
 
 
 /**
- * Read and process a message from the given socket.
+ * Process a datagram we received.
  *
  * @param plugin the overall plugin
- * @param rsock socket to read from
+ * @param buf the datagram
+ * @param size number of bytes in @a buf
+ * @param sa address of the sender
+ * @param fromlen number of bytes in @a sa
  */
 static void
-udp_select_read (struct Plugin *plugin,
-                 struct GNUNET_NETWORK_Handle *rsock)
+udp_process_datagram (struct Plugin *plugin,
+                      const char *buf,
+                      ssize_t size,
+                      const struct sockaddr *sa,
+                      socklen_t fromlen)
 {
-  socklen_t fromlen;
-  struct sockaddr_storage addr;
-  char buf[65536] GNUNET_ALIGN;
-  ssize_t size;
   const struct GNUNET_MessageHeader *msg;
   struct IPv4UdpAddress v4;
   struct IPv6UdpAddress v6;
-  const struct sockaddr *sa;
   const struct sockaddr_in *sa4;
   const struct sockaddr_in6 *sa6;
   const union UdpAddress *int_addr;
   size_t int_addr_len;
   enum GNUNET_ATS_Network_Type network_type;
 
-  fromlen = sizeof (addr);
-  memset (&addr,
-          0,
-          sizeof(addr));
-  size = GNUNET_NETWORK_socket_recvfrom (rsock,
-                                         buf,
-                                         sizeof(buf),
-                                         (struct sockaddr *) &addr,
-                                         &fromlen);
-  sa = (const struct sockaddr *) &addr;
-#if MINGW
-  /* On SOCK_DGRAM UDP sockets recvfrom might fail with a
-   * WSAECONNRESET error to indicate that previous sendto() (yes, sendto!)
-   * on this socket has failed.
-   * Quote from MSDN:
-   *   WSAECONNRESET - The virtual circuit was reset by the remote side
-   *   executing a hard or abortive close. The application should close
-   *   the socket; it is no longer usable. On a UDP-datagram socket this
-   *   error indicates a previous send operation resulted in an ICMP Port
-   *   Unreachable message.
-   */
-  if ( (-1 == size) &&
-       (ECONNRESET == errno) )
-    return;
-#endif
-  if (-1 == size)
-  {
-    LOG (GNUNET_ERROR_TYPE_DEBUG,
-         "UDP failed to receive data: %s\n",
-         STRERROR (errno));
-    /* Connection failure or something. Not a protocol violation. */
-    return;
-  }
-
-
   /* PROCESS STUN PACKET */
   if(GNUNET_NAT_is_valid_stun_packet(plugin->nat,(uint8_t *)buf, size ))
     return;
@@ -2904,7 +3102,7 @@ udp_select_read (struct Plugin *plugin,
   switch (sa->sa_family)
   {
   case AF_INET:
-    sa4 = (const struct sockaddr_in *) &addr;
+    sa4 = (const struct sockaddr_in *) sa;
     v4.options = 0;
     v4.ipv4_addr = sa4->sin_addr.s_addr;
     v4.u4_port = sa4->sin_port;
@@ -2912,7 +3110,7 @@ udp_select_read (struct Plugin *plugin,
     int_addr_len = sizeof (v4);
     break;
   case AF_INET6:
-    sa6 = (const struct sockaddr_in6 *) &addr;
+    sa6 = (const struct sockaddr_in6 *) sa;
     v6.options = 0;
     v6.ipv6_addr = sa6->sin6_addr;
     v6.u6_port = sa6->sin6_port;
@@ -2967,6 +3165,84 @@ udp_select_read (struct Plugin *plugin,
 }
 
 
+/**
+ * Read and process up to #UDP_IO_BATCH datagrams from the given socket.
+ *
+ * @param plugin the overall plugin
+ * @param rsock socket to read from
+ */
+static void
+udp_select_read (struct Plugin *plugin,
+                 struct GNUNET_NETWORK_Handle *rsock)
+{
+  struct GNUNET_NETWORK_Datagram dgrams[UDP_IO_BATCH];
+  struct sockaddr_storage addrs[UDP_IO_BATCH];
+  unsigned int i;
+  size_t off;
+  int ret;
+
+  if (NULL == plugin->read_buf)
+    plugin->read_buf = GNUNET_malloc (UDP_IO_BATCH * UDP_READ_BUFFER_SIZE);
+  memset (addrs,
+          0,
+          sizeof (addrs));
+  for (i = 0; i < UDP_IO_BATCH; i++)
+  {
+    dgrams[i].buffer = &plugin->read_buf[i * UDP_READ_BUFFER_SIZE];
+    dgrams[i].length = UDP_READ_BUFFER_SIZE;
+    dgrams[i].addr = (struct sockaddr *) &addrs[i];
+    dgrams[i].addrlen = sizeof (addrs[i]);
+    dgrams[i].segment_size = 0;
+  }
+  ret = GNUNET_NETWORK_socket_recvfrom_batch (rsock,
+                                              dgrams,
+                                              UDP_IO_BATCH);
+#if MINGW
+  /* On SOCK_DGRAM UDP sockets recvfrom might fail with a
+   * WSAECONNRESET error to indicate that previous sendto() (yes, sendto!)
+   * on this socket has failed.
+   * Quote from MSDN:
+   *   WSAECONNRESET - The virtual circuit was reset by the remote side
+   *   executing a hard or abortive close. The application should close
+   *   the socket; it is no longer usable. On a UDP-datagram socket this
+   *   error indicates a previous send operation resulted in an ICMP Port
+   *   Unreachable message.
+   */
+  if ( (GNUNET_SYSERR == ret) &&
+       (ECONNRESET == errno) )
+    return;
+#endif
+  if (GNUNET_SYSERR == ret)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "UDP failed to receive data: %s\n",
+         STRERROR (errno));
+    /* Connection failure or something. Not a protocol violation. */
+    return;
+  }
+  for (i = 0; i < (unsigned int) ret; i++)
+  {
+    if (0 == dgrams[i].segment_size)
+    {
+      udp_process_datagram (plugin,
+                            dgrams[i].buffer,
+                            dgrams[i].length,
+                            dgrams[i].addr,
+                            dgrams[i].addrlen);
+      continue;
+    }
+    /* the kernel coalesced several datagrams from the same sender */
+    for (off = 0; off < dgrams[i].length; off += dgrams[i].segment_size)
+      udp_process_datagram (plugin,
+                            (char *) dgrams[i].buffer + off,
+                            GNUNET_MIN (dgrams[i].segment_size,
+                                        dgrams[i].length - off),
+                            dgrams[i].addr,
+                            dgrams[i].addrlen);
+  }
+}
+
+
 /**
  * Removes messages from the transmission queue that have
  * timed out, and then selects a message that should be
@@ -3120,8 +3396,109 @@ analyze_send_error (struct Plugin *plugin,
 
 
 /**
- * It is time to try to transmit a UDP message.  Select one
- * and send.
+ * Report the result of a transmission attempt of a UDP message
+ * and release it.
+ *
+ * @param plugin the plugin
+ * @param udpw message we tried to transmit, already dequeued
+ * @param a address we sent the message to
+ * @param slen number of bytes in @a a
+ * @param eno 0 on success, otherwise the errno of the failure
+ */
+static void
+udp_send_done (struct Plugin *plugin,
+               struct UDP_MessageWrapper *udpw,
+               const struct sockaddr *a,
+               socklen_t slen,
+               int eno)
+{
+  struct Session *session = udpw->session;
+
+  if (0 != eno)
+  {
+    /* Failure */
+    analyze_send_error (plugin,
+                        a,
+                        slen,
+                        eno);
+    udpw->qc (udpw->qc_cls,
+              udpw,
+              GNUNET_SYSERR);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, bytes, sent, failure",
+                              GNUNET_SYSERR,
+                              GNUNET_NO);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, messages, sent, failure",
+                              1,
+                              GNUNET_NO);
+  }
+  else
+  {
+    /* Success */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "UDP transmitted %u-byte message to  `%s' `%s'\n",
+         (unsigned int) (udpw->msg_size),
+         GNUNET_i2s (&session->target),
+         GNUNET_a2s (a,
+                     slen));
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, bytes, sent, success",
+                              udpw->msg_size,
+                              GNUNET_NO);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# UDP, total, messages, sent, success",
+                              1,
+                              GNUNET_NO);
+    if (NULL != udpw->frag_ctx)
+      udpw->frag_ctx->on_wire_size += udpw->msg_size;
+    udpw->qc (udpw->qc_cls,
+              udpw,
+              GNUNET_OK);
+  }
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  GNUNET_free (udpw);
+}
+
+
+/**
+ * Check if a message can be appended to a datagram that is to be
+ * sent with segmentation offload.  All segments but the last must
+ * have the same size, and the kernel limits the number of segments
+ * and the overall size.
+ *
+ * @param dgram datagram built so far
+ * @param segments number of segments already in @a dgram
+ * @param udpw message we would like to append
+ * @return #GNUNET_YES if @a udpw can be appended
+ */
+static int
+can_coalesce (const struct GNUNET_NETWORK_Datagram *dgram,
+              unsigned int segments,
+              const struct UDP_MessageWrapper *udpw)
+{
+  size_t seg;
+
+  seg = (0 == dgram->segment_size)
+    ? dgram->length
+    : dgram->segment_size;
+  if ( (segments >= UDP_GSO_MAX_SEGMENTS) ||
+       (udpw->msg_size > seg) ||
+       (0 != dgram->length % seg) ||
+       (dgram->length + udpw->msg_size > UDP_GSO_MAX_BYTES) )
+    return GNUNET_NO;
+  return GNUNET_YES;
+}
+
+
+/**
+ * It is time to try to transmit UDP messages.  Select up to
+ * #UDP_IO_BATCH datagrams and send them with a single call, repeating
+ * until the queue is empty.  If the socket supports segmentation
+ * offload, consecutive messages for the same session are coalesced
+ * into one datagram that the kernel splits again.
  *
  * @param plugin the plugin
  * @param sock which socket (v4/v6) to send on
@@ -3130,119 +3507,167 @@ static void
 udp_select_send (struct Plugin *plugin,
                  struct GNUNET_NETWORK_Handle *sock)
 {
-  ssize_t sent;
-  socklen_t slen;
-  const struct sockaddr *a;
+  struct GNUNET_NETWORK_Datagram dgrams[UDP_IO_BATCH];
+  struct UDP_MessageWrapper *batch[UDP_IO_BATCH * UDP_GSO_MAX_SEGMENTS];
+  unsigned int first[UDP_IO_BATCH + 1];
+  union
+  {
+    struct sockaddr_in a4;
+    struct sockaddr_in6 a6;
+  } addrs[UDP_IO_BATCH];
   const struct IPv4UdpAddress *u4;
-  struct sockaddr_in a4;
   const struct IPv6UdpAddress *u6;
-  struct sockaddr_in6 a6;
   struct UDP_MessageWrapper *udpw;
+  struct Session *session;
+  char *gso;
+  int *offload;
+  unsigned int n;
+  unsigned int nw;
+  unsigned int off;
+  unsigned int i;
+  unsigned int j;
+  int sent;
+  int eno;
 
+  offload = (sock == plugin->sockv4)
+    ? &plugin->offload_v4
+    : &plugin->offload_v6;
+  if ( (GNUNET_YES == *offload) &&
+       (NULL == plugin->gso_buf) )
+    plugin->gso_buf = GNUNET_malloc (UDP_IO_BATCH * UDP_GSO_MAX_BYTES);
   /* Find message(s) to send */
-  while (NULL != (udpw = remove_timeout_messages_and_select (plugin,
-                                                             sock)))
+  do
   {
-    if (sizeof (struct IPv4UdpAddress) == udpw->session->address->address_length)
+    n = 0;
+    nw = 0;
+    while (NULL != (udpw = remove_timeout_messages_and_select (plugin,
+                                                               sock)))
     {
-      u4 = udpw->session->address->address;
-      memset (&a4,
-              0,
-              sizeof(a4));
-      a4.sin_family = AF_INET;
+      if ( (GNUNET_YES == *offload) &&
+           (n > 0) &&
+           (batch[nw - 1]->session == udpw->session) &&
+           (GNUNET_YES == can_coalesce (&dgrams[n - 1],
+                                        nw - first[n - 1],
+                                        udpw)) )
+      {
+        gso = &plugin->gso_buf[(n - 1) * UDP_GSO_MAX_BYTES];
+        if (0 == dgrams[n - 1].segment_size)
+        {
+          /* second segment, move the first one into our buffer */
+          memcpy (gso,
+                  dgrams[n - 1].buffer,
+                  dgrams[n - 1].length);
+          dgrams[n - 1].buffer = gso;
+          dgrams[n - 1].segment_size = dgrams[n - 1].length;
+        }
+        memcpy (&gso[dgrams[n - 1].length],
+                udpw->msg_buf,
+                udpw->msg_size);
+        dgrams[n - 1].length += udpw->msg_size;
+        dequeue (plugin,
+                 udpw);
+        udpw->session->rc++;
+        batch[nw++] = udpw;
+        continue;
+      }
+      if (UDP_IO_BATCH == n)
+        break;
+      if (sizeof (struct IPv4UdpAddress) == udpw->session->address->address_length)
+      {
+        u4 = udpw->session->address->address;
+        memset (&addrs[n].a4,
+                0,
+                sizeof(addrs[n].a4));
+        addrs[n].a4.sin_family = AF_INET;
 #if HAVE_SOCKADDR_IN_SIN_LEN
-      a4.sin_len = sizeof (a4);
+        addrs[n].a4.sin_len = sizeof (addrs[n].a4);
 #endif
-      a4.sin_port = u4->u4_port;
-      a4.sin_addr.s_addr = u4->ipv4_addr;
-      a = (const struct sockaddr *) &a4;
-      slen = sizeof (a4);
-    }
-    else if (sizeof (struct IPv6UdpAddress) == udpw->session->address->address_length)
-    {
-      u6 = udpw->session->address->address;
-      memset (&a6,
-              0,
-              sizeof(a6));
-      a6.sin6_family = AF_INET6;
+        addrs[n].a4.sin_port = u4->u4_port;
+        addrs[n].a4.sin_addr.s_addr = u4->ipv4_addr;
+        dgrams[n].addrlen = sizeof (addrs[n].a4);
+      }
+      else if (sizeof (struct IPv6UdpAddress) == udpw->session->address->address_length)
+      {
+        u6 = udpw->session->address->address;
+        memset (&addrs[n].a6,
+                0,
+                sizeof(addrs[n].a6));
+        addrs[n].a6.sin6_family = AF_INET6;
 #if HAVE_SOCKADDR_IN_SIN_LEN
-      a6.sin6_len = sizeof (a6);
+        addrs[n].a6.sin6_len = sizeof (addrs[n].a6);
 #endif
-      a6.sin6_port = u6->u6_port;
-      a6.sin6_addr = u6->ipv6_addr;
-      a = (const struct sockaddr *) &a6;
-      slen = sizeof (a6);
-    }
-    else
-    {
-      GNUNET_break (0);
+        addrs[n].a6.sin6_port = u6->u6_port;
+        addrs[n].a6.sin6_addr = u6->ipv6_addr;
+        dgrams[n].addrlen = sizeof (addrs[n].a6);
+      }
+      else
+      {
+        GNUNET_break (0);
+        dequeue (plugin,
+                 udpw);
+        udpw->qc (udpw->qc_cls,
+                  udpw,
+                  GNUNET_SYSERR);
+        notify_session_monitor (plugin,
+                                udpw->session,
+                                GNUNET_TRANSPORT_SS_UPDATE);
+        GNUNET_free (udpw);
+        continue;
+      }
+      dgrams[n].addr = (struct sockaddr *) &addrs[n];
+      dgrams[n].buffer = udpw->msg_buf;
+      dgrams[n].length = udpw->msg_size;
+      dgrams[n].segment_size = 0;
       dequeue (plugin,
                udpw);
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_SYSERR);
-      notify_session_monitor (plugin,
-                              udpw->session,
-                              GNUNET_TRANSPORT_SS_UPDATE);
-      GNUNET_free (udpw);
-      continue;
-    }
-    sent = GNUNET_NETWORK_socket_sendto (sock,
-                                         udpw->msg_buf,
-                                         udpw->msg_size,
-                                         a,
-                                         slen);
-    dequeue (plugin,
-             udpw);
-    if (GNUNET_SYSERR == sent)
-    {
-      /* Failure */
-      analyze_send_error (plugin,
-                          a,
-                          slen,
-                          errno);
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_SYSERR);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, bytes, sent, failure",
-                                sent,
-                                GNUNET_NO);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, messages, sent, failure",
-                                1,
-                                GNUNET_NO);
+      /* keep the session alive until we reported the result,
+         a continuation may disconnect it */
+      udpw->session->rc++;
+      first[n++] = nw;
+      batch[nw++] = udpw;
     }
-    else
+    first[n] = nw;
+    off = 0;
+    while (off < n)
     {
-      /* Success */
-      LOG (GNUNET_ERROR_TYPE_DEBUG,
-           "UDP transmitted %u-byte message to  `%s' `%s' (%d: %s)\n",
-           (unsigned int) (udpw->msg_size),
-           GNUNET_i2s (&udpw->session->target),
-           GNUNET_a2s (a,
-                       slen),
-           (int ) sent,
-           (sent < 0) ? STRERROR (errno) : "ok");
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, bytes, sent, success",
-                                sent,
-                                GNUNET_NO);
-      GNUNET_STATISTICS_update (plugin->env->stats,
-                                "# UDP, total, messages, sent, success",
-                                1,
-                                GNUNET_NO);
-      if (NULL != udpw->frag_ctx)
-        udpw->frag_ctx->on_wire_size += udpw->msg_size;
-      udpw->qc (udpw->qc_cls,
-                udpw,
-                GNUNET_OK);
+      sent = GNUNET_NETWORK_socket_sendto_batch (sock,
+                                                 &dgrams[off],
+                                                 n - off);
+      eno = errno;
+      if (GNUNET_SYSERR == sent)
+      {
+        sent = 1;
+        if ( (0 != dgrams[off].segment_size) &&
+             (EIO == eno) )
+        {
+          /* the device cannot do segmentation offload after all */
+          LOG (GNUNET_ERROR_TYPE_INFO,
+               "Disabling UDP segmentation offload\n");
+          *offload = GNUNET_NO;
+        }
+      }
+      else
+        eno = 0;
+      for (i = off; i < off + sent; i++)
+      {
+        for (j = first[i]; j < first[i + 1]; j++)
+        {
+          session = batch[j]->session;
+          udp_send_done (plugin,
+                         batch[j],
+                         dgrams[i].addr,
+                         dgrams[i].addrlen,
+                         eno);
+          session->rc--;
+          if ( (0 == session->rc) &&
+               (GNUNET_YES == session->in_destroy) )
+            free_session (session);
+        }
+      }
+      off += sent;
     }
-    notify_session_monitor (plugin,
-                            udpw->session,
-                            GNUNET_TRANSPORT_SS_UPDATE);
-    GNUNET_free (udpw);
   }
+  while (NULL != udpw);
 }
 
 
@@ -3313,6 +3738,39 @@ udp_plugin_select_v6 (void *cls,
 /* ******************* Initialization *************** */
 
 
+/**
+ * Enable segmentation offload on a freshly bound socket and have the
+ * kernel pace our transmissions to the configured bandwidth limit
+ * (effective with the "fq" queueing discipline), so that bursts of
+ * coalesced datagrams do not exceed our quota on the wire.
+ *
+ * @param plugin the plugin
+ * @param sock the socket
+ * @return #GNUNET_YES if the socket supports segmentation offload
+ */
+static int
+setup_offload (struct Plugin *plugin,
+               struct GNUNET_NETWORK_Handle *sock)
+{
+#ifdef SO_MAX_PACING_RATE
+  unsigned int rate;
+
+  rate = (unsigned int) GNUNET_MIN (plugin->max_bps,
+                                    UINT_MAX);
+  if (GNUNET_OK !=
+      GNUNET_NETWORK_socket_setsockopt (sock,
+                                        SOL_SOCKET,
+                                        SO_MAX_PACING_RATE,
+                                        &rate,
+                                        sizeof (rate)))
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Failed to set pacing rate: %s\n",
+         STRERROR (errno));
+#endif
+  return GNUNET_NETWORK_socket_udp_offload (sock);
+}
+
+
 /**
  * Setup the UDP sockets (for IPv4 and IPv6) for the plugin.
  *
@@ -3415,6 +3873,8 @@ setup_sockets (struct Plugin *plugin,
              "IPv6 UDP socket created listinging at %s\n",
              GNUNET_a2s (server_addr,
                          addrlen));
+        plugin->offload_v6 = setup_offload (plugin,
+                                            plugin->sockv6);
         addrs[sockets_created] = server_addr;
         addrlens[sockets_created] = addrlen;
         sockets_created++;
@@ -3514,6 +3974,8 @@ setup_sockets (struct Plugin *plugin,
            "IPv4 socket created on port %s\n",
            GNUNET_a2s (server_addr,
                        addrlen));
+      plugin->offload_v4 = setup_offload (plugin,
+                                          plugin->sockv4);
       addrs[sockets_created] = server_addr;
       addrlens[sockets_created] = addrlen;
       sockets_created++;
@@ -3723,10 +4185,14 @@ libgnunet_plugin_transport_udp_init (void *cls)
   p->enable_ipv4 = GNUNET_YES; /* default */
   p->enable_broadcasting = enable_broadcasting;
   p->enable_broadcasting_receiving = enable_broadcasting_recv;
+  p->max_bps = udp_max_bps;
   p->env = env;
   p->sessions = GNUNET_CONTAINER_multipeermap_create (16,
                                                       GNUNET_NO);
   p->defrag_ctxs = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  p->resumption = GNUNET_CONTAINER_multipeermap_create (16,
+                                                        GNUNET_NO);
+  p->resumption_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
   p->mst = GNUNET_SERVER_mst_create (&process_inbound_tokenized_messages,
                                      p);
   GNUNET_BANDWIDTH_tracker_init (&p->tracker,
@@ -3745,6 +4211,8 @@ libgnunet_plugin_transport_udp_init (void *cls)
         _("Failed to create UDP network sockets\n"));
     GNUNET_CONTAINER_multipeermap_destroy (p->sessions);
     GNUNET_CONTAINER_heap_destroy (p->defrag_ctxs);
+    GNUNET_CONTAINER_multipeermap_destroy (p->resumption);
+    GNUNET_CONTAINER_heap_destroy (p->resumption_heap);
     GNUNET_SERVER_mst_destroy (p->mst);
     GNUNET_free (p);
     return NULL;
@@ -3812,6 +4280,7 @@ libgnunet_plugin_transport_udp_done (void *cls)
   struct Plugin *plugin = api->cls;
   struct PrettyPrinterContext *cur;
   struct UDP_MessageWrapper *udpw;
+  struct ResumptionEntry *re;
 
   if (NULL == plugin)
   {
@@ -3881,6 +4350,11 @@ libgnunet_plugin_transport_udp_done (void *cls)
                                          &disconnect_and_free_it,
                                          plugin);
   GNUNET_CONTAINER_multipeermap_destroy (plugin->sessions);
+  while (NULL != (re = GNUNET_CONTAINER_heap_peek (plugin->resumption_heap)))
+    free_resumption_entry (plugin,
+                           re);
+  GNUNET_CONTAINER_multipeermap_destroy (plugin->resumption);
+  GNUNET_CONTAINER_heap_destroy (plugin->resumption_heap);
 
   while (NULL != (cur = plugin->ppc_dll_head))
   {
@@ -3891,6 +4365,8 @@ libgnunet_plugin_transport_udp_done (void *cls)
     GNUNET_RESOLVER_request_cancel (cur->resolver_handle);
     GNUNET_free (cur);
   }
+  GNUNET_free_non_null (plugin->read_buf);
+  GNUNET_free_non_null (plugin->gso_buf);
   GNUNET_free (plugin);
   GNUNET_free (api);
   return NULL;
@@ -154,6 +154,18 @@ struct Plugin
    */
   struct GNUNET_CONTAINER_Heap *defrag_ctxs;
 
+  /**
+   * Congestion control state of peers whose sessions ended, map of
+   * peer identity to `struct ResumptionEntry *`.
+   */
+  struct GNUNET_CONTAINER_MultiPeerMap *resumption;
+
+  /**
+   * Heap of the `struct ResumptionEntry` in @e resumption, by
+   * expiration time.
+   */
+  struct GNUNET_CONTAINER_Heap *resumption_heap;
+
   /**
    * ID of select task for IPv4
    */
@@ -269,6 +281,37 @@ struct Plugin
    */
   struct GNUNET_TIME_Relative broadcast_interval;
 
+  /**
+   * Buffers for the datagrams read in one batch by
+   * udp_select_read(), allocated on first use.
+   */
+  char *read_buf;
+
+  /**
+   * Buffers for coalescing datagrams to the same peer into one
+   * segmentation offload send in udp_select_send(), allocated on
+   * first use.
+   */
+  char *gso_buf;
+
+  /**
+   * Does the IPv4 socket support segmentation offload?
+   * #GNUNET_YES or #GNUNET_NO
+   */
+  int offload_v4;
+
+  /**
+   * Does the IPv6 socket support segmentation offload?
+   * #GNUNET_YES or #GNUNET_NO
+   */
+  int offload_v6;
+
+  /**
+   * Maximum number of bytes per second we send, used to have the
+   * kernel pace our transmissions.
+   */
+  unsigned long long max_bps;
+
   /**
    * Bytes currently in buffer
    */
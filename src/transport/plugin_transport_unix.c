@@ -35,6 +35,63 @@
 #include "gnunet_transport_plugin.h"
 #include "transport.h"
 
+#if LINUX && HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#if defined(SYS_memfd_create) && defined(F_ADD_SEALS)
+/**
+ * Sessions can move their traffic to shared memory rings.
+ */
+#define UNIX_SHM 1
+#endif
+#endif
+#ifndef UNIX_SHM
+#define UNIX_SHM 0
+#endif
+
+#if UNIX_SHM
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+#ifndef MFD_ALLOW_SEALING
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+/**
+ * Size of the data area of the shared memory ring we create for
+ * sending to a peer.  Must be a multiple of 8.
+ */
+#define UNIX_SHM_RING_SIZE (1024 * 1024)
+
+/**
+ * Smallest data area we accept for a ring offered by another peer
+ * (must fit the largest record).
+ */
+#define UNIX_SHM_MIN_RING_SIZE (128 * 1024)
+
+/**
+ * Largest data area we accept for a ring offered by another peer.
+ */
+#define UNIX_SHM_MAX_RING_SIZE (64 * 1024 * 1024)
+
+/**
+ * Largest payload we put into a single record of the ring.
+ */
+#define UNIX_SHM_MAX_RECORD (65536 - sizeof (struct UNIXMessage))
+
+/**
+ * Record size value marking that the producer continued at the
+ * beginning of the data area.
+ */
+#define UNIX_SHM_WRAP UINT32_MAX
+
+/**
+ * Number of file descriptors passed with an offer: the memory
+ * segment, the "data available" and the "space available" eventfds.
+ */
+#define UNIX_SHM_NUM_FDS 3
+#endif
+
 
 /**
  * Return code we give on 'send' if we failed to send right now
@@ -111,9 +168,173 @@ struct UNIXMessage
 
 };
 
+
+/**
+ * Offer of a shared memory ring (with the memory segment and the
+ * eventfds passed as ancillary data), or the acknowledgement of
+ * such an offer.
+ */
+struct UNIXShmMessage
+{
+  /**
+   * Header, with type #GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_OFFER
+   * or #GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_ACK.
+   */
+  struct UNIXMessage header;
+
+  /**
+   * Random identifier of the ring, in NBO.
+   */
+  uint32_t ring_id GNUNET_PACKED;
+
+};
+
 GNUNET_NETWORK_STRUCT_END
 
 
+#if UNIX_SHM
+/**
+ * Layout of the beginning of a shared memory ring.  The ring is
+ * written by exactly one process (the peer sending) and read by
+ * exactly one other; the counters are only ever advanced, and
+ * offsets into the data area are the counters modulo its size.
+ * The data area contains records of a `struct UNIX_ShmRecord`
+ * followed by the payload, padded to a multiple of 8 bytes.
+ */
+struct UNIX_ShmRing
+{
+  /**
+   * Number of bytes the producer has written so far.
+   */
+  uint64_t head;
+
+  /**
+   * Keep the counters on different cache lines.
+   */
+  char pad1[56];
+
+  /**
+   * Number of bytes the consumer has read so far.
+   */
+  uint64_t tail;
+
+  /**
+   * Keep the counters on different cache lines.
+   */
+  char pad2[56];
+
+  /**
+   * Set by the consumer before it waits for the "data" eventfd.
+   */
+  uint32_t reader_waiting;
+
+  /**
+   * Set by the producer before it waits for the "space" eventfd.
+   */
+  uint32_t writer_waiting;
+
+  /**
+   * Keep the data area on its own cache line.
+   */
+  char pad3[56];
+
+  /* followed by the data area */
+};
+
+
+/**
+ * Header of a record in the data area of a ring.
+ */
+struct UNIX_ShmRecord
+{
+  /**
+   * Number of bytes of payload, or #UNIX_SHM_WRAP.
+   */
+  uint32_t size;
+
+  /**
+   * Keep the payload 8-byte aligned.
+   */
+  uint32_t reserved;
+
+  /* followed by the payload */
+};
+
+
+/**
+ * One direction of a session in shared memory, from the point of
+ * view of either the producer or the consumer.
+ */
+struct UNIX_ShmChannel
+{
+  /**
+   * The mapped ring, NULL if not in use.
+   */
+  struct UNIX_ShmRing *ring;
+
+  /**
+   * Size of the data area of @e ring.
+   */
+  size_t size;
+
+  /**
+   * Our copy of the counter we advance (head for the producer, tail
+   * for the consumer); we never trust the copy in shared memory.
+   */
+  uint64_t off;
+
+  /**
+   * Memory segment of @e ring.
+   */
+  int mem_fd;
+
+  /**
+   * Eventfd signalled when data was added.
+   */
+  struct GNUNET_DISK_FileHandle *data;
+
+  /**
+   * Eventfd signalled when space was freed.
+   */
+  struct GNUNET_DISK_FileHandle *space;
+
+  /**
+   * Task flushing (producer) or reading (consumer) the ring.
+   */
+  struct GNUNET_SCHEDULER_Task *task;
+
+  /**
+   * Random identifier of the ring.
+   */
+  uint32_t ring_id;
+
+};
+
+
+/**
+ * State of the shared memory ring we send to a peer with.
+ */
+enum UNIX_ShmState
+{
+  /**
+   * We did not offer a ring (yet).
+   */
+  UNIX_SHM_NONE = 0,
+
+  /**
+   * We offered a ring but the peer did not acknowledge it (yet);
+   * peers without shared memory support never will.
+   */
+  UNIX_SHM_OFFERED,
+
+  /**
+   * The peer maps our ring, new messages go there.
+   */
+  UNIX_SHM_ACTIVE
+};
+#endif
+
+
 /**
  * Information we track for a message awaiting transmission.
  */
@@ -225,6 +446,55 @@ struct Session
    */
   unsigned int msgs_in_queue;
 
+#if UNIX_SHM
+  /**
+   * Messages waiting for space in @e shm_tx.
+   */
+  struct UNIXMessageWrapper *shm_head;
+
+  /**
+   * Messages waiting for space in @e shm_tx.
+   */
+  struct UNIXMessageWrapper *shm_tail;
+
+  /**
+   * Messages written to @e shm_tx whose continuation is pending.
+   */
+  struct UNIXMessageWrapper *shm_done_head;
+
+  /**
+   * Messages written to @e shm_tx whose continuation is pending.
+   */
+  struct UNIXMessageWrapper *shm_done_tail;
+
+  /**
+   * Ring we send with.
+   */
+  struct UNIX_ShmChannel shm_tx;
+
+  /**
+   * Ring the peer sends with.
+   */
+  struct UNIX_ShmChannel shm_rx;
+
+  /**
+   * State of @e shm_tx.
+   */
+  enum UNIX_ShmState shm_state;
+
+  /**
+   * Number of the @e msgs_in_queue that are waiting for @e shm_tx.
+   */
+  unsigned int shm_msgs_in_queue;
+
+  /**
+   * #GNUNET_YES while we pass messages from @e shm_rx to the
+   * transport service, #GNUNET_SYSERR if the session was
+   * disconnected meanwhile (and must be freed once we are done).
+   */
+  int shm_rx_busy;
+#endif
+
 };
 
 
@@ -322,6 +592,12 @@ struct Plugin
    */
   int is_abstract;
 
+  /**
+   * Do we offer shared memory rings to other peers (and accept
+   * theirs)?
+   */
+  int enable_shm;
+
 };
 
 
@@ -420,6 +696,44 @@ unix_plugin_address_to_string (void *cls,
 }
 
 
+#if UNIX_SHM
+/**
+ * Stop using a shared memory ring and release its resources.
+ *
+ * @param ch channel to close
+ */
+static void
+shm_channel_close (struct UNIX_ShmChannel *ch)
+{
+  if (NULL != ch->task)
+  {
+    GNUNET_SCHEDULER_cancel (ch->task);
+    ch->task = NULL;
+  }
+  if (NULL != ch->ring)
+  {
+    if (0 != munmap (ch->ring,
+                     sizeof (struct UNIX_ShmRing) + ch->size))
+      GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                           "munmap");
+    ch->ring = NULL;
+  }
+  if (NULL != ch->data)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (ch->data));
+    ch->data = NULL;
+  }
+  if (NULL != ch->space)
+  {
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (ch->space));
+    ch->space = NULL;
+  }
+  ch->size = 0;
+  ch->off = 0;
+}
+#endif
+
+
 /**
  * Functions with this signature are called whenever we need
  * to close a session due to a disconnect or failure to
@@ -469,6 +783,43 @@ unix_plugin_session_disconnect (void *cls,
     GNUNET_free (msgw->msg);
     GNUNET_free (msgw);
   }
+#if UNIX_SHM
+  while (NULL != (msgw = session->shm_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (session->shm_head,
+                                 session->shm_tail,
+                                 msgw);
+    session->msgs_in_queue--;
+    session->shm_msgs_in_queue--;
+    GNUNET_assert (session->bytes_in_queue >= msgw->msgsize);
+    session->bytes_in_queue -= msgw->msgsize;
+    GNUNET_assert (plugin->bytes_in_queue >= msgw->msgsize);
+    plugin->bytes_in_queue -= msgw->msgsize;
+    if (NULL != msgw->cont)
+      msgw->cont (msgw->cont_cls,
+                  &msgw->session->target,
+                  GNUNET_SYSERR,
+                  msgw->payload, 0);
+    GNUNET_free (msgw->msg);
+    GNUNET_free (msgw);
+  }
+  while (NULL != (msgw = session->shm_done_head))
+  {
+    /* already in the ring, so this one did make it */
+    GNUNET_CONTAINER_DLL_remove (session->shm_done_head,
+                                 session->shm_done_tail,
+                                 msgw);
+    if (NULL != msgw->cont)
+      msgw->cont (msgw->cont_cls,
+                  &msgw->session->target,
+                  GNUNET_OK,
+                  msgw->payload,
+                  msgw->msgsize);
+    GNUNET_free_non_null (msgw->msg);
+    GNUNET_free (msgw);
+  }
+  shm_channel_close (&session->shm_tx);
+#endif
   GNUNET_assert (GNUNET_YES ==
                  GNUNET_CONTAINER_multipeermap_remove (plugin->session_map,
 						       &session->target,
@@ -489,6 +840,15 @@ unix_plugin_session_disconnect (void *cls,
   GNUNET_HELLO_address_free (session->address);
   GNUNET_break (0 == session->bytes_in_queue);
   GNUNET_break (0 == session->msgs_in_queue);
+#if UNIX_SHM
+  if (GNUNET_YES == session->shm_rx_busy)
+  {
+    /* we are called from shm_rx_task(), which frees the session */
+    session->shm_rx_busy = GNUNET_SYSERR;
+    return GNUNET_OK;
+  }
+  shm_channel_close (&session->shm_rx);
+#endif
   GNUNET_free (session);
   return GNUNET_OK;
 }
@@ -930,33 +1290,24 @@ unix_plugin_update_session_timeout (void *cls,
 
 
 /**
- * Demultiplexer for UNIX messages
+ * Find the session for a peer that sent us something, creating it
+ * if needed.
  *
  * @param plugin the main plugin for this transport
  * @param sender from which peer the message was received
- * @param currhdr pointer to the header of the message
- * @param ua address to look for
+ * @param ua address of the sender
  * @param ua_len length of the address @a ua
+ * @return the session
  */
-static void
-unix_demultiplexer (struct Plugin *plugin,
-                    struct GNUNET_PeerIdentity *sender,
-                    const struct GNUNET_MessageHeader *currhdr,
-                    const struct UnixAddress *ua,
-                    size_t ua_len)
+static struct Session *
+unix_get_inbound_session (struct Plugin *plugin,
+                          const struct GNUNET_PeerIdentity *sender,
+                          const struct UnixAddress *ua,
+                          size_t ua_len)
 {
   struct Session *session;
   struct GNUNET_HELLO_Address *address;
 
-  GNUNET_assert (ua_len >= sizeof (struct UnixAddress));
-  LOG (GNUNET_ERROR_TYPE_DEBUG,
-       "Received message from %s\n",
-       unix_plugin_address_to_string (NULL, ua, ua_len));
-  GNUNET_STATISTICS_update (plugin->env->stats,
-			    "# bytes received via UNIX",
-			    ntohs (currhdr->size),
-			    GNUNET_NO);
-
   /* Look for existing session */
   address = GNUNET_HELLO_address_allocate (sender,
                                            PLUGIN_NAME,
@@ -977,6 +1328,39 @@ unix_demultiplexer (struct Plugin *plugin,
     reschedule_session_timeout (session);
   }
   GNUNET_HELLO_address_free (address);
+  return session;
+}
+
+
+/**
+ * Demultiplexer for UNIX messages
+ *
+ * @param plugin the main plugin for this transport
+ * @param sender from which peer the message was received
+ * @param currhdr pointer to the header of the message
+ * @param ua address to look for
+ * @param ua_len length of the address @a ua
+ */
+static void
+unix_demultiplexer (struct Plugin *plugin,
+                    struct GNUNET_PeerIdentity *sender,
+                    const struct GNUNET_MessageHeader *currhdr,
+                    const struct UnixAddress *ua,
+                    size_t ua_len)
+{
+  struct Session *session;
+
+  GNUNET_assert (ua_len >= sizeof (struct UnixAddress));
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Received message from %s\n",
+       unix_plugin_address_to_string (NULL, ua, ua_len));
+  GNUNET_STATISTICS_update (plugin->env->stats,
+			    "# bytes received via UNIX",
+			    ntohs (currhdr->size),
+			    GNUNET_NO);
+  session = unix_get_inbound_session (plugin,
+                                      sender,
+                                      ua, ua_len);
   plugin->env->receive (plugin->env->cls,
                         session->address,
                         session,
@@ -985,14 +1369,921 @@ unix_demultiplexer (struct Plugin *plugin,
 
 
 /**
- * Read from UNIX domain socket (it is ready).
+ * We have been notified that our socket is ready to write.
+ * Then reschedule this function to be called again once more is available.
  *
- * @param plugin the plugin
+ * @param cls the plugin handle
+ * @param tc the scheduling context
  */
 static void
-unix_plugin_do_read (struct Plugin *plugin)
-{
-  char buf[65536] GNUNET_ALIGN;
+unix_plugin_select_write (void *cls,
+                          const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Queue a message for transmission over the UNIX domain socket.
+ *
+ * @param plugin the plugin
+ * @param session session the message belongs to
+ * @param message the message, ownership passes to the queue
+ * @param ssize number of bytes in @a message
+ * @param payload bytes of payload encapsulated in @a message
+ * @param priority how important is the message (ignored by UNIX)
+ * @param to how long to wait at most for the transmission
+ * @param cont continuation to call once the message has
+ *        been transmitted; can be NULL
+ * @param cont_cls closure for @a cont
+ */
+static void
+unix_queue_datagram (struct Plugin *plugin,
+                     struct Session *session,
+                     struct UNIXMessage *message,
+                     size_t ssize,
+                     size_t payload,
+                     unsigned int priority,
+                     struct GNUNET_TIME_Relative to,
+                     GNUNET_TRANSPORT_TransmitContinuation cont,
+                     void *cont_cls)
+{
+  struct UNIXMessageWrapper *wrapper;
+
+  wrapper = GNUNET_new (struct UNIXMessageWrapper);
+  wrapper->msg = message;
+  wrapper->msgsize = ssize;
+  wrapper->payload = payload;
+  wrapper->priority = priority;
+  wrapper->timeout = GNUNET_TIME_absolute_add (GNUNET_TIME_absolute_get (),
+                                               to);
+  wrapper->cont = cont;
+  wrapper->cont_cls = cont_cls;
+  wrapper->session = session;
+  GNUNET_CONTAINER_DLL_insert_tail (plugin->msg_head,
+                                    plugin->msg_tail,
+                                    wrapper);
+  plugin->bytes_in_queue += ssize;
+  session->bytes_in_queue += ssize;
+  session->msgs_in_queue++;
+  GNUNET_STATISTICS_set (plugin->env->stats,
+			 "# bytes currently in UNIX buffers",
+			 plugin->bytes_in_queue,
+			 GNUNET_NO);
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  if (NULL == plugin->write_task)
+    plugin->write_task =
+      GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                      plugin->unix_sock.desc,
+                                      &unix_plugin_select_write, plugin);
+}
+
+
+#if UNIX_SHM
+/**
+ * Append a record to a ring we produce.
+ *
+ * @param ch the ring
+ * @param buf payload of the record
+ * @param size number of bytes in @a buf
+ * @return #GNUNET_OK on success, #GNUNET_NO if the ring is too full
+ */
+static int
+shm_ring_write (struct UNIX_ShmChannel *ch,
+                const void *buf,
+                size_t size)
+{
+  char *data = (char *) &ch->ring[1];
+  struct UNIX_ShmRecord *rec;
+  uint64_t tail;
+  size_t need;
+  size_t pos;
+  size_t skip;
+
+  need = sizeof (struct UNIX_ShmRecord) + ((size + 7) & ~((size_t) 7));
+  tail = __atomic_load_n (&ch->ring->tail,
+                          __ATOMIC_ACQUIRE);
+  if (ch->off - tail > ch->size)
+  {
+    /* consumer corrupted its counter, it will not get anything anymore */
+    GNUNET_break_op (0);
+    return GNUNET_NO;
+  }
+  pos = ch->off % ch->size;
+  skip = 0;
+  if (need > ch->size - pos)
+    skip = ch->size - pos;
+  if (skip + need > ch->size - (ch->off - tail))
+    return GNUNET_NO;
+  if (0 != skip)
+  {
+    rec = (struct UNIX_ShmRecord *) &data[pos];
+    rec->size = UNIX_SHM_WRAP;
+    pos = 0;
+  }
+  rec = (struct UNIX_ShmRecord *) &data[pos];
+  rec->size = (uint32_t) size;
+  memcpy (&rec[1], buf, size);
+  ch->off += skip + need;
+  __atomic_store_n (&ch->ring->head,
+                    ch->off,
+                    __ATOMIC_RELEASE);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Wake up the other side of a ring if it announced that it is
+ * waiting for us.
+ *
+ * @param waiting the announcement in the ring
+ * @param efd eventfd the other side is waiting for
+ */
+static void
+shm_signal (uint32_t *waiting,
+            struct GNUNET_DISK_FileHandle *efd)
+{
+  uint64_t one = 1;
+
+  /* order our update of the ring before reading the flag; the
+     other side sets the flag before checking the ring again */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (0 == __atomic_exchange_n (waiting,
+                                0,
+                                __ATOMIC_SEQ_CST))
+    return;
+  if (sizeof (one) !=
+      GNUNET_DISK_file_write (efd,
+                              &one,
+                              sizeof (one)))
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "write");
+}
+
+
+/**
+ * Write the messages of a session waiting for its shared memory ring
+ * to the ring and call the continuations of the messages written.
+ *
+ * @param cls the `struct Session *`
+ * @param tc scheduler context
+ */
+static void
+shm_tx_flush (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Session *session = cls;
+  struct Plugin *plugin = session->plugin;
+  struct UNIX_ShmChannel *ch = &session->shm_tx;
+  struct UNIXMessageWrapper *msgw;
+  struct UNIXMessageWrapper *done_head;
+  struct UNIXMessageWrapper *done_tail;
+  struct UNIXMessageWrapper *failed_head;
+  struct UNIXMessageWrapper *failed_tail;
+  struct GNUNET_PeerIdentity target;
+  uint64_t val;
+  int written;
+
+  ch->task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  /* reset the "space" eventfd in case it woke us */
+  (void) GNUNET_DISK_file_read (ch->space,
+                                &val,
+                                sizeof (val));
+  failed_head = NULL;
+  failed_tail = NULL;
+  written = GNUNET_NO;
+  /* datagrams queued before the peer acknowledged the ring go first;
+     unix_plugin_do_write() runs us again once they are out */
+  while ( (session->msgs_in_queue == session->shm_msgs_in_queue) &&
+          (NULL != (msgw = session->shm_head)) )
+  {
+    if (0 == GNUNET_TIME_absolute_get_remaining (msgw->timeout).rel_value_us)
+    {
+      GNUNET_CONTAINER_DLL_remove (session->shm_head,
+                                   session->shm_tail,
+                                   msgw);
+      GNUNET_CONTAINER_DLL_insert_tail (failed_head,
+                                        failed_tail,
+                                        msgw);
+    }
+    else if (GNUNET_OK !=
+             shm_ring_write (ch,
+                             &msgw->msg[1],
+                             msgw->payload))
+    {
+      /* ring is full, ask the consumer to wake us, and check
+         again in case it made space before seeing the flag */
+      __atomic_store_n (&ch->ring->writer_waiting,
+                        1,
+                        __ATOMIC_SEQ_CST);
+      __atomic_thread_fence (__ATOMIC_SEQ_CST);
+      if (GNUNET_OK !=
+          shm_ring_write (ch,
+                          &msgw->msg[1],
+                          msgw->payload))
+      {
+        ch->task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                   ch->space,
+                                                   &shm_tx_flush,
+                                                   session);
+        break;
+      }
+      __atomic_store_n (&ch->ring->writer_waiting,
+                        0,
+                        __ATOMIC_RELAXED);
+      written = GNUNET_YES;
+      GNUNET_CONTAINER_DLL_remove (session->shm_head,
+                                   session->shm_tail,
+                                   msgw);
+      GNUNET_CONTAINER_DLL_insert_tail (session->shm_done_head,
+                                        session->shm_done_tail,
+                                        msgw);
+    }
+    else
+    {
+      written = GNUNET_YES;
+      GNUNET_CONTAINER_DLL_remove (session->shm_head,
+                                   session->shm_tail,
+                                   msgw);
+      GNUNET_CONTAINER_DLL_insert_tail (session->shm_done_head,
+                                        session->shm_done_tail,
+                                        msgw);
+    }
+    session->msgs_in_queue--;
+    session->shm_msgs_in_queue--;
+    GNUNET_assert (session->bytes_in_queue >= msgw->msgsize);
+    session->bytes_in_queue -= msgw->msgsize;
+    GNUNET_assert (plugin->bytes_in_queue >= msgw->msgsize);
+    plugin->bytes_in_queue -= msgw->msgsize;
+  }
+  /* one wakeup for everything written since the last flush */
+  if ( (GNUNET_YES == written) ||
+       (NULL != session->shm_done_head) )
+    shm_signal (&ch->ring->reader_waiting,
+                ch->data);
+  if ( (NULL == failed_head) &&
+       (NULL == session->shm_done_head) )
+    return;
+  GNUNET_STATISTICS_set (plugin->env->stats,
+                         "# bytes currently in UNIX buffers",
+                         plugin->bytes_in_queue,
+                         GNUNET_NO);
+  notify_session_monitor (plugin,
+                          session,
+                          GNUNET_TRANSPORT_SS_UPDATE);
+  /* continuations may disconnect the session, so we must not touch
+     it anymore from here on */
+  target = session->target;
+  done_head = session->shm_done_head;
+  done_tail = session->shm_done_tail;
+  session->shm_done_head = NULL;
+  session->shm_done_tail = NULL;
+  while (NULL != (msgw = failed_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (failed_head,
+                                 failed_tail,
+                                 msgw);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+			      "# UNIX bytes discarded",
+			      msgw->msgsize,
+			      GNUNET_NO);
+    if (NULL != msgw->cont)
+      msgw->cont (msgw->cont_cls,
+		  &target,
+		  GNUNET_SYSERR,
+		  msgw->payload,
+		  0);
+    GNUNET_free (msgw->msg);
+    GNUNET_free (msgw);
+  }
+  while (NULL != (msgw = done_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (done_head,
+                                 done_tail,
+                                 msgw);
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# bytes transmitted via UNIX shared memory",
+                              msgw->msgsize,
+                              GNUNET_NO);
+    if (NULL != msgw->cont)
+      msgw->cont (msgw->cont_cls,
+                  &target,
+                  GNUNET_OK,
+                  msgw->payload,
+                  msgw->msgsize);
+    GNUNET_free_non_null (msgw->msg);
+    GNUNET_free (msgw);
+  }
+}
+
+
+/**
+ * Make sure the messages of a session waiting for its shared
+ * memory ring get written.
+ *
+ * @param session the session
+ */
+static void
+shm_tx_schedule (struct Session *session)
+{
+  if ( (NULL == session->shm_tx.task) &&
+       (NULL != session->shm_head) )
+    session->shm_tx.task = GNUNET_SCHEDULER_add_now (&shm_tx_flush,
+                                                     session);
+}
+
+
+/**
+ * Transmit a message via the shared memory ring of a session.
+ *
+ * @param session the session, must have an active ring
+ * @param msgbuf the message to transmit
+ * @param msgbuf_size number of bytes in @a msgbuf
+ * @param priority how important is the message (ignored)
+ * @param to how long to wait at most for the transmission
+ * @param cont continuation to call once the message has
+ *        been transmitted; can be NULL
+ * @param cont_cls closure for @a cont
+ * @return number of bytes used in the ring
+ */
+static ssize_t
+shm_send (struct Session *session,
+          const char *msgbuf,
+          size_t msgbuf_size,
+          unsigned int priority,
+          struct GNUNET_TIME_Relative to,
+          GNUNET_TRANSPORT_TransmitContinuation cont,
+          void *cont_cls)
+{
+  struct Plugin *plugin = session->plugin;
+  struct UNIXMessageWrapper *wrapper;
+  ssize_t ssize;
+
+  ssize = sizeof (struct UNIX_ShmRecord) + msgbuf_size;
+  wrapper = GNUNET_new (struct UNIXMessageWrapper);
+  wrapper->msgsize = ssize;
+  wrapper->payload = msgbuf_size;
+  wrapper->priority = priority;
+  wrapper->timeout = GNUNET_TIME_relative_to_absolute (to);
+  wrapper->cont = cont;
+  wrapper->cont_cls = cont_cls;
+  wrapper->session = session;
+  if ( (0 == session->msgs_in_queue) &&
+       (GNUNET_OK == shm_ring_write (&session->shm_tx,
+                                     msgbuf,
+                                     msgbuf_size)) )
+  {
+    /* written right away, shm_tx_flush() wakes the peer and
+       calls the continuation */
+    GNUNET_CONTAINER_DLL_insert_tail (session->shm_done_head,
+                                      session->shm_done_tail,
+                                      wrapper);
+  }
+  else
+  {
+    wrapper->msg = GNUNET_malloc (sizeof (struct UNIXMessage) + msgbuf_size);
+    memcpy (&wrapper->msg[1], msgbuf, msgbuf_size);
+    GNUNET_CONTAINER_DLL_insert_tail (session->shm_head,
+                                      session->shm_tail,
+                                      wrapper);
+    plugin->bytes_in_queue += ssize;
+    session->bytes_in_queue += ssize;
+    session->msgs_in_queue++;
+    session->shm_msgs_in_queue++;
+    GNUNET_STATISTICS_set (plugin->env->stats,
+                           "# bytes currently in UNIX buffers",
+                           plugin->bytes_in_queue,
+                           GNUNET_NO);
+    notify_session_monitor (plugin,
+                            session,
+                            GNUNET_TRANSPORT_SS_UPDATE);
+  }
+  if (NULL == session->shm_tx.task)
+    session->shm_tx.task = GNUNET_SCHEDULER_add_now (&shm_tx_flush,
+                                                     session);
+  return ssize;
+}
+
+
+/**
+ * Pass the messages of a record from a shared memory ring to the
+ * transport service.
+ *
+ * @param session session the ring belongs to
+ * @param buf the record's payload
+ * @param size number of bytes in @a buf
+ */
+static void
+shm_deliver (struct Session *session,
+             const char *buf,
+             size_t size)
+{
+  struct Plugin *plugin = session->plugin;
+  const struct GNUNET_MessageHeader *currhdr;
+  size_t offset;
+  uint16_t csize;
+
+  reschedule_session_timeout (session);
+  offset = 0;
+  while (offset + sizeof (struct GNUNET_MessageHeader) <= size)
+  {
+    currhdr = (const struct GNUNET_MessageHeader *) &buf[offset];
+    csize = ntohs (currhdr->size);
+    if ( (csize < sizeof (struct GNUNET_MessageHeader)) ||
+         (csize > size - offset) )
+    {
+      GNUNET_break_op (0);
+      return;
+    }
+    GNUNET_STATISTICS_update (plugin->env->stats,
+                              "# bytes received via UNIX",
+                              csize,
+                              GNUNET_NO);
+    plugin->env->receive (plugin->env->cls,
+                          session->address,
+                          session,
+                          currhdr);
+    if (GNUNET_SYSERR == session->shm_rx_busy)
+      return; /* session was disconnected */
+    offset += csize;
+  }
+}
+
+
+/**
+ * Read the records a peer wrote to its shared memory ring.
+ *
+ * @param cls the `struct Session *`
+ * @param tc scheduler context
+ */
+static void
+shm_rx_task (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Session *session = cls;
+  struct UNIX_ShmChannel *ch = &session->shm_rx;
+  char buf[65536] GNUNET_ALIGN;
+  const char *data = (const char *) &ch->ring[1];
+  const struct UNIX_ShmRecord *rec;
+  uint64_t head;
+  uint64_t start;
+  uint64_t val;
+  uint32_t rsize;
+  size_t need;
+  size_t pos;
+  int broken;
+
+  ch->task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
+    return;
+  /* reset the "data" eventfd in case it woke us */
+  (void) GNUNET_DISK_file_read (ch->data,
+                                &val,
+                                sizeof (val));
+  broken = GNUNET_NO;
+  start = ch->off;
+  head = __atomic_load_n (&ch->ring->head,
+                          __ATOMIC_ACQUIRE);
+  if (head - ch->off > ch->size)
+  {
+    GNUNET_break_op (0);
+    broken = GNUNET_YES;
+    head = ch->off;
+  }
+  session->shm_rx_busy = GNUNET_YES;
+  /* at most one ring's worth per run, to not starve other tasks */
+  while ( (ch->off != head) &&
+          (ch->off - start < ch->size) )
+  {
+    pos = ch->off % ch->size;
+    rec = (const struct UNIX_ShmRecord *) &data[pos];
+    rsize = __atomic_load_n (&rec->size,
+                             __ATOMIC_RELAXED);
+    if (UNIX_SHM_WRAP == rsize)
+    {
+      ch->off += ch->size - pos;
+      continue;
+    }
+    need = sizeof (struct UNIX_ShmRecord) + ((rsize + 7) & ~((size_t) 7));
+    if ( (rsize > UNIX_SHM_MAX_RECORD) ||
+         (need > ch->size - pos) ||
+         (need > head - ch->off) )
+    {
+      GNUNET_break_op (0);
+      broken = GNUNET_YES;
+      break;
+    }
+    /* copy first, the peer must not be able to change the
+       messages while we check and process them */
+    memcpy (buf, &rec[1], rsize);
+    ch->off += need;
+    __atomic_store_n (&ch->ring->tail,
+                      ch->off,
+                      __ATOMIC_RELEASE);
+    shm_deliver (session,
+                 buf,
+                 rsize);
+    if (GNUNET_SYSERR == session->shm_rx_busy)
+      break;
+  }
+  if (GNUNET_SYSERR == session->shm_rx_busy)
+  {
+    /* unix_plugin_session_disconnect() left this to us */
+    shm_channel_close (ch);
+    GNUNET_free (session);
+    return;
+  }
+  session->shm_rx_busy = GNUNET_NO;
+  if (GNUNET_YES == broken)
+  {
+    shm_channel_close (ch);
+    return;
+  }
+  if (ch->off != start)
+    shm_signal (&ch->ring->writer_waiting,
+                ch->space);
+  /* announce that we are going to wait, then check once more */
+  __atomic_store_n (&ch->ring->reader_waiting,
+                    1,
+                    __ATOMIC_SEQ_CST);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&ch->ring->head,
+                       __ATOMIC_ACQUIRE) != ch->off)
+  {
+    __atomic_store_n (&ch->ring->reader_waiting,
+                      0,
+                      __ATOMIC_RELAXED);
+    ch->task = GNUNET_SCHEDULER_add_now (&shm_rx_task,
+                                         session);
+    return;
+  }
+  ch->task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                             ch->data,
+                                             &shm_rx_task,
+                                             session);
+}
+
+
+/**
+ * Create a shared memory ring for sending to the peer of a session,
+ * and offer it to the peer.  If the peer acknowledges the offer, we
+ * switch to the ring; otherwise we just continue using datagrams.
+ *
+ * @param session the session
+ */
+static void
+shm_offer (struct Session *session)
+{
+  struct Plugin *plugin = session->plugin;
+  struct UNIX_ShmChannel *ch = &session->shm_tx;
+  const struct UnixAddress *ua = session->address->address;
+  struct UNIXShmMessage msg;
+  struct sockaddr_un *un;
+  socklen_t un_len;
+  struct msghdr mh;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE (UNIX_SHM_NUM_FDS * sizeof (int))];
+  int fds[UNIX_SHM_NUM_FDS];
+  size_t len;
+  void *ring;
+  ssize_t sent;
+
+  /* we only try once per session */
+  session->shm_state = UNIX_SHM_OFFERED;
+  len = sizeof (struct UNIX_ShmRing) + UNIX_SHM_RING_SIZE;
+  fds[0] = syscall (SYS_memfd_create,
+                    "gnunet-transport-unix",
+                    MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (-1 == fds[0])
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "memfd_create");
+    return;
+  }
+  /* the peer must be able to rely on the size of the mapping */
+  if ( (0 != ftruncate (fds[0], len)) ||
+       (0 != fcntl (fds[0],
+                    F_ADD_SEALS,
+                    F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "ftruncate");
+    GNUNET_break (0 == close (fds[0]));
+    return;
+  }
+  ring = mmap (NULL,
+               len,
+               PROT_READ | PROT_WRITE,
+               MAP_SHARED,
+               fds[0],
+               0);
+  if (MAP_FAILED == ring)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "mmap");
+    GNUNET_break (0 == close (fds[0]));
+    return;
+  }
+  ch->ring = ring;
+  ch->size = UNIX_SHM_RING_SIZE;
+  ch->off = 0;
+  fds[1] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  fds[2] = eventfd (0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (-1 != fds[1])
+    ch->data = GNUNET_DISK_get_handle_from_int_fd (fds[1]);
+  if (-1 != fds[2])
+    ch->space = GNUNET_DISK_get_handle_from_int_fd (fds[2]);
+  if ( (NULL == ch->data) ||
+       (NULL == ch->space) )
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "eventfd");
+    if ( (-1 != fds[1]) && (NULL == ch->data) )
+      GNUNET_break (0 == close (fds[1]));
+    if ( (-1 != fds[2]) && (NULL == ch->space) )
+      GNUNET_break (0 == close (fds[2]));
+    GNUNET_break (0 == close (fds[0]));
+    shm_channel_close (ch);
+    return;
+  }
+  /* the consumer maps the ring later; make the first write wake it */
+  ch->ring->reader_waiting = 1;
+  ch->ring_id = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                          UINT32_MAX);
+
+  /* the header only covers the `struct UNIXMessage`, so that peers
+     without shared memory support see an empty message */
+  memset (&msg, 0, sizeof (msg));
+  msg.header.header.size = htons (sizeof (struct UNIXMessage));
+  msg.header.header.type = htons (GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_OFFER);
+  msg.header.sender = *plugin->env->my_identity;
+  msg.ring_id = htonl (ch->ring_id);
+  if (NULL == (un = unix_address_to_sockaddr ((const char *) &ua[1],
+                                              &un_len)))
+  {
+    GNUNET_break (0);
+    GNUNET_break (0 == close (fds[0]));
+    shm_channel_close (ch);
+    return;
+  }
+  if ((GNUNET_YES == plugin->is_abstract) &&
+      (0 != (UNIX_OPTIONS_USE_ABSTRACT_SOCKETS & ntohl (ua->options))) )
+    un->sun_path[0] = '\0';
+  iov.iov_base = &msg;
+  iov.iov_len = sizeof (msg);
+  memset (&mh, 0, sizeof (mh));
+  mh.msg_name = un;
+  mh.msg_namelen = un_len;
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = cbuf;
+  mh.msg_controllen = sizeof (cbuf);
+  cmsg = CMSG_FIRSTHDR (&mh);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (UNIX_SHM_NUM_FDS * sizeof (int));
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (fds));
+  sent = sendmsg (GNUNET_NETWORK_get_fd (plugin->unix_sock.desc),
+                  &mh,
+                  MSG_DONTWAIT);
+  GNUNET_free (un);
+  /* the mapping stays valid without the segment's descriptor */
+  GNUNET_break (0 == close (fds[0]));
+  if (-1 == sent)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Failed to offer shared memory to `%s': %s\n",
+         GNUNET_i2s (&session->target),
+         STRERROR (errno));
+    shm_channel_close (ch);
+    return;
+  }
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# UNIX shared memory rings offered",
+                            1,
+                            GNUNET_NO);
+}
+
+
+/**
+ * A peer offered us its shared memory ring; start reading from it
+ * and acknowledge the offer.
+ *
+ * @param plugin the plugin
+ * @param sender peer that made the offer
+ * @param ua address of the sender
+ * @param ua_len length of @a ua
+ * @param ring_id identifier of the ring in NBO
+ * @param fds descriptors passed with the offer, we take ownership
+ * @param nfds number of entries in @a fds
+ */
+static void
+shm_handle_offer (struct Plugin *plugin,
+                  const struct GNUNET_PeerIdentity *sender,
+                  const struct UnixAddress *ua,
+                  size_t ua_len,
+                  uint32_t ring_id,
+                  int *fds,
+                  unsigned int nfds)
+{
+  struct Session *session;
+  struct UNIX_ShmChannel *ch;
+  struct UNIXShmMessage *ack;
+  struct stat sbuf;
+  size_t size;
+  void *ring;
+  unsigned int i;
+  int seals;
+
+  if ( (GNUNET_YES != plugin->enable_shm) ||
+       (UNIX_SHM_NUM_FDS != nfds) )
+    goto cleanup;
+  session = unix_get_inbound_session (plugin,
+                                      sender,
+                                      ua, ua_len);
+  if (NULL == session)
+    goto cleanup;
+  if (0 != fstat (fds[0], &sbuf))
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "fstat");
+    goto cleanup;
+  }
+  seals = fcntl (fds[0], F_GET_SEALS);
+  if ( (-1 == seals) ||
+       (0 == (seals & F_SEAL_SHRINK)) ||
+       (sbuf.st_size < (off_t) (sizeof (struct UNIX_ShmRing) + UNIX_SHM_MIN_RING_SIZE)) ||
+       (sbuf.st_size > (off_t) (sizeof (struct UNIX_ShmRing) + UNIX_SHM_MAX_RING_SIZE)) ||
+       (0 != (sbuf.st_size - sizeof (struct UNIX_ShmRing)) % 8) )
+  {
+    GNUNET_break_op (0);
+    goto cleanup;
+  }
+  size = sbuf.st_size - sizeof (struct UNIX_ShmRing);
+  ring = mmap (NULL,
+               sbuf.st_size,
+               PROT_READ | PROT_WRITE,
+               MAP_SHARED,
+               fds[0],
+               0);
+  if (MAP_FAILED == ring)
+  {
+    GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                         "mmap");
+    goto cleanup;
+  }
+  GNUNET_break (0 == close (fds[0]));
+  ch = &session->shm_rx;
+  shm_channel_close (ch);
+  ch->ring = ring;
+  ch->size = size;
+  ch->off = 0;
+  ch->ring_id = ntohl (ring_id);
+  ch->data = GNUNET_DISK_get_handle_from_int_fd (fds[1]);
+  ch->space = GNUNET_DISK_get_handle_from_int_fd (fds[2]);
+  ch->task = GNUNET_SCHEDULER_add_now (&shm_rx_task,
+                                       session);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Receiving from `%s' via shared memory\n",
+       GNUNET_i2s (sender));
+  ack = GNUNET_new (struct UNIXShmMessage);
+  ack->header.header.size = htons (sizeof (struct UNIXMessage));
+  ack->header.header.type = htons (GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_ACK);
+  ack->header.sender = *plugin->env->my_identity;
+  ack->ring_id = ring_id;
+  unix_queue_datagram (plugin,
+                       session,
+                       &ack->header,
+                       sizeof (struct UNIXShmMessage),
+                       0,
+                       0,
+                       GNUNET_TIME_UNIT_FOREVER_REL,
+                       NULL, NULL);
+  return;
+ cleanup:
+  for (i = 0; i < nfds; i++)
+    GNUNET_break (0 == close (fds[i]));
+}
+
+
+/**
+ * A peer acknowledged our offer of a shared memory ring; switch
+ * to the ring.
+ *
+ * @param plugin the plugin
+ * @param sender peer that sent the acknowledgement
+ * @param ua address of the sender
+ * @param ua_len length of @a ua
+ * @param ring_id identifier of the ring in NBO
+ */
+static void
+shm_handle_ack (struct Plugin *plugin,
+                const struct GNUNET_PeerIdentity *sender,
+                const struct UnixAddress *ua,
+                size_t ua_len,
+                uint32_t ring_id)
+{
+  struct GNUNET_HELLO_Address *address;
+  struct Session *session;
+
+  address = GNUNET_HELLO_address_allocate (sender,
+                                           PLUGIN_NAME,
+                                           ua, ua_len,
+                                           GNUNET_HELLO_ADDRESS_INFO_NONE);
+  session = lookup_session (plugin, address);
+  GNUNET_HELLO_address_free (address);
+  if ( (NULL == session) ||
+       (UNIX_SHM_OFFERED != session->shm_state) ||
+       (NULL == session->shm_tx.ring) ||
+       (ntohl (ring_id) != session->shm_tx.ring_id) )
+  {
+    GNUNET_break_op (0);
+    return;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Sending to `%s' via shared memory\n",
+       GNUNET_i2s (sender));
+  session->shm_state = UNIX_SHM_ACTIVE;
+  GNUNET_STATISTICS_update (plugin->env->stats,
+                            "# UNIX shared memory rings in use",
+                            1,
+                            GNUNET_NO);
+}
+
+
+/**
+ * Receive a datagram from our socket, together with the
+ * file descriptors passed with it.
+ *
+ * @param plugin the plugin
+ * @param buf where to store the datagram
+ * @param size number of bytes available in @a buf
+ * @param[out] un address of the sender
+ * @param[in,out] addrlen length of @a un
+ * @param[out] fds where to store the descriptors (#UNIX_SHM_NUM_FDS)
+ * @param[out] nfds set to the number of descriptors received
+ * @return number of bytes received, #GNUNET_SYSERR on error
+ */
+static ssize_t
+shm_recv (struct Plugin *plugin,
+          void *buf,
+          size_t size,
+          struct sockaddr_un *un,
+          socklen_t *addrlen,
+          int *fds,
+          unsigned int *nfds)
+{
+  struct msghdr mh;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char cbuf[CMSG_SPACE (UNIX_SHM_NUM_FDS * sizeof (int))] GNUNET_ALIGN;
+  ssize_t ret;
+  size_t n;
+
+  *nfds = 0;
+  iov.iov_base = buf;
+  iov.iov_len = size;
+  memset (&mh, 0, sizeof (mh));
+  mh.msg_name = un;
+  mh.msg_namelen = *addrlen;
+  mh.msg_iov = &iov;
+  mh.msg_iovlen = 1;
+  mh.msg_control = cbuf;
+  mh.msg_controllen = sizeof (cbuf);
+  ret = recvmsg (GNUNET_NETWORK_get_fd (plugin->unix_sock.desc),
+                 &mh,
+                 MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+  if (-1 == ret)
+    return GNUNET_SYSERR;
+  *addrlen = mh.msg_namelen;
+  for (cmsg = CMSG_FIRSTHDR (&mh); NULL != cmsg; cmsg = CMSG_NXTHDR (&mh, cmsg))
+  {
+    if ( (SOL_SOCKET != cmsg->cmsg_level) ||
+         (SCM_RIGHTS != cmsg->cmsg_type) ||
+         (cmsg->cmsg_len < CMSG_LEN (0)) )
+      continue;
+    n = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+    if (n > UNIX_SHM_NUM_FDS - *nfds)
+      n = UNIX_SHM_NUM_FDS - *nfds; /* cannot happen, would not fit cbuf */
+    memcpy (&fds[*nfds], CMSG_DATA (cmsg), n * sizeof (int));
+    *nfds += n;
+  }
+  return ret;
+}
+#endif
+
+
+/**
+ * Read from UNIX domain socket (it is ready).
+ *
+ * @param plugin the plugin
+ */
+static void
+unix_plugin_do_read (struct Plugin *plugin)
+{
+  char buf[65536] GNUNET_ALIGN;
   struct UnixAddress *ua;
   struct UNIXMessage *msg;
   struct GNUNET_PeerIdentity sender;
@@ -1006,13 +2297,28 @@ unix_plugin_do_read (struct Plugin *plugin)
   const struct GNUNET_MessageHeader *currhdr;
   uint16_t csize;
   size_t ua_len;
+#if UNIX_SHM
+  const struct UNIXShmMessage *smsg;
+  int fds[UNIX_SHM_NUM_FDS];
+  unsigned int nfds;
+  unsigned int i;
+#endif
 
   addrlen = sizeof (un);
   memset (&un, 0, sizeof (un));
+#if UNIX_SHM
+  ret = shm_recv (plugin,
+                  buf, sizeof (buf),
+                  &un,
+                  &addrlen,
+                  fds,
+                  &nfds);
+#else
   ret = GNUNET_NETWORK_socket_recvfrom (plugin->unix_sock.desc,
                                         buf, sizeof (buf),
                                         (struct sockaddr *) &un,
                                         &addrlen);
+#endif
   if ((GNUNET_SYSERR == ret) && ((errno == EAGAIN) || (errno == ENOBUFS)))
     return;
   if (GNUNET_SYSERR == ret)
@@ -1051,6 +2357,10 @@ unix_plugin_do_read (struct Plugin *plugin)
   if ((csize < sizeof (struct UNIXMessage)) || (csize > ret))
   {
     GNUNET_break_op (0);
+#if UNIX_SHM
+    for (i = 0; i < nfds; i++)
+      GNUNET_break (0 == close (fds[i]));
+#endif
     GNUNET_free (ua);
     return;
   }
@@ -1058,6 +2368,33 @@ unix_plugin_do_read (struct Plugin *plugin)
   memcpy (&sender,
           &msg->sender,
           sizeof (struct GNUNET_PeerIdentity));
+#if UNIX_SHM
+  smsg = (const struct UNIXShmMessage *) buf;
+  if ( (GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_OFFER == ntohs (msg->header.type)) &&
+       (ret >= sizeof (struct UNIXShmMessage)) )
+  {
+    shm_handle_offer (plugin,
+                      &sender,
+                      ua, ua_len,
+                      smsg->ring_id,
+                      fds,
+                      nfds);
+    GNUNET_free (ua);
+    return;
+  }
+  for (i = 0; i < nfds; i++)
+    GNUNET_break (0 == close (fds[i]));
+  if ( (GNUNET_MESSAGE_TYPE_TRANSPORT_UNIX_SHM_ACK == ntohs (msg->header.type)) &&
+       (ret >= sizeof (struct UNIXShmMessage)) )
+  {
+    shm_handle_ack (plugin,
+                    &sender,
+                    ua, ua_len,
+                    smsg->ring_id);
+    GNUNET_free (ua);
+    return;
+  }
+#endif
   offset = 0;
   tsize = csize - sizeof (struct UNIXMessage);
   while (offset + sizeof (struct GNUNET_MessageHeader) <= tsize)
@@ -1110,6 +2447,9 @@ unix_plugin_do_write (struct Plugin *plugin)
     session->bytes_in_queue -= msgw->msgsize;
     GNUNET_assert (plugin->bytes_in_queue >= msgw->msgsize);
     plugin->bytes_in_queue -= msgw->msgsize;
+#if UNIX_SHM
+    shm_tx_schedule (session);
+#endif
     GNUNET_STATISTICS_set (plugin->env->stats,
 			   "# bytes currently in UNIX buffers",
 			   plugin->bytes_in_queue,
@@ -1165,6 +2505,9 @@ unix_plugin_do_write (struct Plugin *plugin)
   session->bytes_in_queue -= msgw->msgsize;
   GNUNET_assert (plugin->bytes_in_queue >= msgw->msgsize);
   plugin->bytes_in_queue -= msgw->msgsize;
+#if UNIX_SHM
+  shm_tx_schedule (session);
+#endif
   GNUNET_STATISTICS_set (plugin->env->stats,
                          "# bytes currently in UNIX buffers",
                          plugin->bytes_in_queue, GNUNET_NO);
@@ -1294,7 +2637,6 @@ unix_plugin_send (void *cls,
                   void *cont_cls)
 {
   struct Plugin *plugin = cls;
-  struct UNIXMessageWrapper *wrapper;
   struct UNIXMessage *message;
   int ssize;
 
@@ -1319,6 +2661,19 @@ unix_plugin_send (void *cls,
        unix_plugin_address_to_string (NULL,
                                       session->address->address,
                                       session->address->address_length));
+#if UNIX_SHM
+  if ( (GNUNET_YES == plugin->enable_shm) &&
+       (UNIX_SHM_NONE == session->shm_state) )
+    shm_offer (session);
+  if ( (UNIX_SHM_ACTIVE == session->shm_state) &&
+       (msgbuf_size <= UNIX_SHM_MAX_RECORD) )
+    return shm_send (session,
+                     msgbuf,
+                     msgbuf_size,
+                     priority,
+                     to,
+                     cont, cont_cls);
+#endif
   ssize = sizeof (struct UNIXMessage) + msgbuf_size;
   message = GNUNET_malloc (sizeof (struct UNIXMessage) + msgbuf_size);
   message->header.size = htons (ssize);
@@ -1326,34 +2681,14 @@ unix_plugin_send (void *cls,
   memcpy (&message->sender, plugin->env->my_identity,
           sizeof (struct GNUNET_PeerIdentity));
   memcpy (&message[1], msgbuf, msgbuf_size);
-  wrapper = GNUNET_new (struct UNIXMessageWrapper);
-  wrapper->msg = message;
-  wrapper->msgsize = ssize;
-  wrapper->payload = msgbuf_size;
-  wrapper->priority = priority;
-  wrapper->timeout = GNUNET_TIME_absolute_add (GNUNET_TIME_absolute_get (),
-                                               to);
-  wrapper->cont = cont;
-  wrapper->cont_cls = cont_cls;
-  wrapper->session = session;
-  GNUNET_CONTAINER_DLL_insert_tail (plugin->msg_head,
-                                    plugin->msg_tail,
-                                    wrapper);
-  plugin->bytes_in_queue += ssize;
-  session->bytes_in_queue += ssize;
-  session->msgs_in_queue++;
-  GNUNET_STATISTICS_set (plugin->env->stats,
-			 "# bytes currently in UNIX buffers",
-			 plugin->bytes_in_queue,
-			 GNUNET_NO);
-  notify_session_monitor (plugin,
-                          session,
-                          GNUNET_TRANSPORT_SS_UPDATE);
-  if (NULL == plugin->write_task)
-    plugin->write_task =
-      GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
-                                      plugin->unix_sock.desc,
-                                      &unix_plugin_select_write, plugin);
+  unix_queue_datagram (plugin,
+                       session,
+                       message,
+                       ssize,
+                       msgbuf_size,
+                       priority,
+                       to,
+                       cont, cont_cls);
   return ssize;
 }
 
@@ -1785,6 +3120,11 @@ libgnunet_plugin_transport_unix_init (void *cls)
   plugin->myoptions = UNIX_OPTIONS_NONE;
   if (GNUNET_YES == plugin->is_abstract)
     plugin->myoptions = UNIX_OPTIONS_USE_ABSTRACT_SOCKETS;
+#if UNIX_SHM
+  plugin->enable_shm = GNUNET_CONFIGURATION_get_value_yesno (plugin->env->cfg,
+                                                             "transport-unix",
+                                                             "ENABLE_SHM");
+#endif
 
   api = GNUNET_new (struct GNUNET_TRANSPORT_PluginFunctions);
   api->cls = plugin;
@@ -386,6 +386,11 @@ struct MacEndpoint
    */
   struct GNUNET_DEFRAGMENT_Context *defrag;
 
+  /**
+   * Congestion control shared by all messages we fragment for this MAC
+   */
+  struct GNUNET_FRAGMENT_Congestion *cc;
+
   /**
    * When should this endpoint time out?
    */
@@ -1137,13 +1142,12 @@ send_with_fragmentation (struct MacEndpoint *endpoint,
   if (GNUNET_YES == plugin->have_mac)
   {
     fm->fragcontext =
-      GNUNET_FRAGMENT_context_create (plugin->env->stats,
-                                      WLAN_MTU,
-                                      &plugin->tracker,
-                                      fm->macendpoint->msg_delay,
-                                      fm->macendpoint->ack_delay,
-                                      msg,
-                                      &transmit_fragment, fm);
+      GNUNET_FRAGMENT_context_create_cc (plugin->env->stats,
+                                         WLAN_MTU,
+                                         &plugin->tracker,
+                                         fm->macendpoint->cc,
+                                         msg,
+                                         &transmit_fragment, fm);
   }
   else
   {
@@ -1176,6 +1180,7 @@ free_macendpoint (struct MacEndpoint *endpoint)
                                     session);
   while (NULL != (fm = endpoint->sending_messages_head))
     free_fragment_message (fm);
+  GNUNET_FRAGMENT_congestion_destroy (endpoint->cc);
   GNUNET_CONTAINER_DLL_remove (plugin->mac_head,
 			       plugin->mac_tail,
 			       endpoint);
@@ -1249,7 +1254,7 @@ create_macendpoint (struct Plugin *plugin,
 				      pos,
 				      &wlan_data_message_handler,
 				      &send_ack);
-
+  pos->cc = GNUNET_FRAGMENT_congestion_create ();
   pos->msg_delay = GNUNET_TIME_UNIT_MILLISECONDS;
   pos->ack_delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS, 100);
   pos->timeout = GNUNET_TIME_relative_to_absolute (MACENDPOINT_TIMEOUT);
@@ -1778,13 +1783,12 @@ handle_helper_message (void *cls, void *client,
             continue;
           }
           fm->fragcontext =
-            GNUNET_FRAGMENT_context_create (plugin->env->stats,
-                                            WLAN_MTU,
-                                            &plugin->tracker,
-                                            fm->macendpoint->msg_delay,
-                                            fm->macendpoint->ack_delay,
-                                            fm->msg,
-                                            &transmit_fragment, fm);
+            GNUNET_FRAGMENT_context_create_cc (plugin->env->stats,
+                                               WLAN_MTU,
+                                               &plugin->tracker,
+                                               fm->macendpoint->cc,
+                                               fm->msg,
+                                               &transmit_fragment, fm);
           GNUNET_free (fm->msg);
           fm->msg = NULL;
         }
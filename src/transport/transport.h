@@ -540,6 +540,69 @@ struct TrafficMetricMessage
 };
 
 
+/**
+ * Message from the library to the transport service
+ * asking for link characteristics to emulate for a peer.
+ */
+struct TrafficEmulationMessage
+{
+  /**
+   * Type will be #GNUNET_MESSAGE_TYPE_TRANSPORT_TRAFFIC_EMULATION
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * #GNUNET_YES if jitter may reorder outbound messages.
+   */
+  uint32_t reorder GNUNET_PACKED;
+
+  /**
+   * The identity of the peer, all zeros for all peers.
+   */
+  struct GNUNET_PeerIdentity peer;
+
+  /**
+   * Fixed delay to add on inbound traffic.
+   */
+  struct GNUNET_TIME_RelativeNBO delay_in;
+
+  /**
+   * Fixed delay to add on outbound traffic.
+   */
+  struct GNUNET_TIME_RelativeNBO delay_out;
+
+  /**
+   * Maximum deviation from the inbound delay.
+   */
+  struct GNUNET_TIME_RelativeNBO jitter_in;
+
+  /**
+   * Maximum deviation from the outbound delay.
+   */
+  struct GNUNET_TIME_RelativeNBO jitter_out;
+
+  /**
+   * Inbound bandwidth cap in bytes/s, 0 for no cap.
+   */
+  uint32_t bandwidth_in GNUNET_PACKED;
+
+  /**
+   * Outbound bandwidth cap in bytes/s, 0 for no cap.
+   */
+  uint32_t bandwidth_out GNUNET_PACKED;
+
+  /**
+   * Inbound loss probability in parts per million.
+   */
+  uint32_t loss_in GNUNET_PACKED;
+
+  /**
+   * Outbound loss probability in parts per million.
+   */
+  uint32_t loss_out GNUNET_PACKED;
+};
+
+
 /**
  * Message from the transport service to the library containing information
  * about a peer. Information contained are:
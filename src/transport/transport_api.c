@@ -1509,7 +1509,7 @@ send_hello (void *cls,
 
 
 /**
- * Send traffic metric message to the service.
+ * Send traffic metric or emulation message to the service.
  *
  * @param cls the message to send
  * @param size number of bytes available in @a buf
@@ -1521,7 +1521,7 @@ send_metric (void *cls,
              size_t size,
              void *buf)
 {
-  struct TrafficMetricMessage *msg = cls;
+  struct GNUNET_MessageHeader *msg = cls;
   uint16_t ssize;
 
   if (NULL == buf)
@@ -1533,7 +1533,7 @@ send_metric (void *cls,
   }
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Transmitting TRAFFIC_METRIC request.\n");
-  ssize = ntohs (msg->header.size);
+  ssize = ntohs (msg->size);
   GNUNET_assert (size >= ssize);
   memcpy (buf, msg, ssize);
   GNUNET_free (msg);
@@ -1578,6 +1578,43 @@ GNUNET_TRANSPORT_set_traffic_metric (struct GNUNET_TRANSPORT_Handle *handle,
 }
 
 
+/**
+ * Emulate the given link characteristics for the traffic with a
+ * peer.  Replaces the delays set with
+ * #GNUNET_TRANSPORT_set_traffic_metric().
+ *
+ * @param handle transport handle
+ * @param peer the peer to emulate the link to, all zeros for
+ *        the default applied to all peers without own settings
+ * @param ep link characteristics to emulate
+ */
+void
+GNUNET_TRANSPORT_set_traffic_emulation (struct GNUNET_TRANSPORT_Handle *handle,
+                                        const struct GNUNET_PeerIdentity *peer,
+                                        const struct GNUNET_TRANSPORT_EmulationParameters *ep)
+{
+  struct TrafficEmulationMessage *msg;
+
+  msg = GNUNET_new (struct TrafficEmulationMessage);
+  msg->header.size = htons (sizeof (struct TrafficEmulationMessage));
+  msg->header.type = htons (GNUNET_MESSAGE_TYPE_TRANSPORT_TRAFFIC_EMULATION);
+  msg->reorder = htonl ((uint32_t) ep->reorder);
+  msg->peer = *peer;
+  msg->delay_in = GNUNET_TIME_relative_hton (ep->delay_in);
+  msg->delay_out = GNUNET_TIME_relative_hton (ep->delay_out);
+  msg->jitter_in = GNUNET_TIME_relative_hton (ep->jitter_in);
+  msg->jitter_out = GNUNET_TIME_relative_hton (ep->jitter_out);
+  msg->bandwidth_in = htonl (ep->bandwidth_in);
+  msg->bandwidth_out = htonl (ep->bandwidth_out);
+  msg->loss_in = htonl (ep->loss_in);
+  msg->loss_out = htonl (ep->loss_out);
+  schedule_control_transmit (handle,
+                             sizeof (struct TrafficEmulationMessage),
+                             &send_metric,
+                             msg);
+}
+
+
 /**
  * Offer the transport service the HELLO of another peer.  Note that
  * the transport service may just ignore this message if the HELLO is
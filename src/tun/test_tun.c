@@ -63,12 +63,88 @@ test_udp (size_t pll,
   }
 }
 
+
+static void
+test_tcp_partial (size_t pll)
+{
+  struct GNUNET_TUN_IPv4Header ip;
+  struct GNUNET_TUN_IPv6Header ip6;
+  struct GNUNET_TUN_TcpHeader tcp;
+  char payload[pll];
+  struct in_addr src;
+  struct in_addr dst;
+  struct in6_addr src6;
+  struct in6_addr dst6;
+  uint16_t partial;
+  uint16_t crc;
+  size_t i;
+
+  GNUNET_assert (1 == inet_pton (AF_INET, "1.2.3.4", &src));
+  GNUNET_assert (1 == inet_pton (AF_INET, "122.2.3.5", &dst));
+  GNUNET_assert (1 == inet_pton (AF_INET6, "fd00::1", &src6));
+  GNUNET_assert (1 == inet_pton (AF_INET6, "2001:db8::42", &dst6));
+  for (i = 0; i < pll; i++)
+    payload[i] = (char) (i * 7 + pll);
+  memset (&tcp, 0, sizeof (tcp));
+  tcp.source_port = htons (4242);
+  tcp.destination_port = htons (80);
+  tcp.seq = htonl (12345678);
+  tcp.off = 5;
+  tcp.window_size = htons (pll);
+  GNUNET_TUN_initialize_ipv4_header (&ip,
+				     IPPROTO_TCP,
+				     pll + sizeof (tcp),
+				     &src,
+				     &dst);
+  GNUNET_TUN_calculate_tcp4_checksum (&ip,
+				      &tcp,
+				      payload,
+				      pll);
+  partial = GNUNET_TUN_tcp_checksum_to_partial (AF_INET,
+                                                &src,
+                                                &dst,
+                                                &tcp,
+                                                pll + sizeof (tcp));
+  /* forward the segment via IPv6 with different ports */
+  tcp.source_port = htons (80);
+  tcp.destination_port = htons (61234);
+  GNUNET_TUN_initialize_ipv6_header (&ip6,
+				     IPPROTO_TCP,
+				     pll + sizeof (tcp),
+				     &src6,
+				     &dst6);
+  GNUNET_TUN_calculate_tcp6_checksum (&ip6,
+				      &tcp,
+				      payload,
+				      pll);
+  crc = tcp.crc;
+  GNUNET_TUN_calculate_tcp_checksum_from_partial (AF_INET6,
+                                                  &src6,
+                                                  &dst6,
+                                                  &tcp,
+                                                  pll + sizeof (tcp),
+                                                  partial);
+  if (crc != tcp.crc)
+  {
+    fprintf (stderr, "Got partial-based CRC: %u, wanted: %u\n",
+	     ntohs (tcp.crc),
+	     ntohs (crc));
+    ret = 1;
+  }
+}
+
+
 int main (int argc,
 	  char **argv)
 {
+  size_t i;
+
   test_udp (4, 3, 22439);
   test_udp (4, 1, 23467);
   test_udp (7, 17, 6516);
   test_udp (12451, 251, 42771);
+  for (i = 0; i < 1500; i += 37)
+    test_tcp_partial (i);
+  test_tcp_partial (12451);
   return ret;
 }
@@ -163,6 +163,138 @@ GNUNET_TUN_calculate_tcp6_checksum (const struct GNUNET_TUN_IPv6Header *ip,
 }
 
 
+/**
+ * Sum up the parts of the TCP checksum that change when a segment is
+ * forwarded through the tunnel: the pseudo header and the ports.
+ *
+ * @param af address family of the addresses (AF_INET or AF_INET6)
+ * @param source_ip source address of the segment
+ * @param destination_ip destination address of the segment
+ * @param tcp TCP header (with ports)
+ * @param tcp_length number of bytes in the TCP header and payload
+ * @return (unfolded) one's complement sum
+ */
+static uint32_t
+tcp_pseudo_sum (int af,
+                const void *source_ip,
+                const void *destination_ip,
+                const struct GNUNET_TUN_TcpHeader *tcp,
+                uint16_t tcp_length)
+{
+  uint32_t sum;
+  uint32_t tmp32;
+  uint16_t tmp16;
+
+  switch (af)
+  {
+  case AF_INET:
+    sum = GNUNET_CRYPTO_crc16_step (0, source_ip, sizeof (struct in_addr));
+    sum = GNUNET_CRYPTO_crc16_step (sum, destination_ip, sizeof (struct in_addr));
+    tmp16 = htons (IPPROTO_TCP);
+    sum = GNUNET_CRYPTO_crc16_step (sum, &tmp16, sizeof (uint16_t));
+    tmp16 = htons (tcp_length);
+    sum = GNUNET_CRYPTO_crc16_step (sum, &tmp16, sizeof (uint16_t));
+    break;
+  case AF_INET6:
+    sum = GNUNET_CRYPTO_crc16_step (0, source_ip, sizeof (struct in6_addr));
+    sum = GNUNET_CRYPTO_crc16_step (sum, destination_ip, sizeof (struct in6_addr));
+    tmp32 = htonl (tcp_length);
+    sum = GNUNET_CRYPTO_crc16_step (sum, &tmp32, sizeof (uint32_t));
+    tmp32 = htonl (IPPROTO_TCP);
+    sum = GNUNET_CRYPTO_crc16_step (sum, &tmp32, sizeof (uint32_t));
+    break;
+  default:
+    GNUNET_assert (0);
+    return 0;
+  }
+  sum = GNUNET_CRYPTO_crc16_step (sum, &tcp->source_port, sizeof (uint16_t));
+  sum = GNUNET_CRYPTO_crc16_step (sum, &tcp->destination_port, sizeof (uint16_t));
+  return sum;
+}
+
+
+/**
+ * Fold a one's complement sum to 16 bits.
+ *
+ * @param sum sum to fold
+ * @return folded sum
+ */
+static uint16_t
+fold_sum (uint32_t sum)
+{
+  sum = (sum >> 16) + (sum & 0xFFFF);
+  sum += (sum >> 16);
+  return (uint16_t) sum;
+}
+
+
+/**
+ * Turn the (valid) checksum of a TCP segment into the one's
+ * complement sum over the TCP header and payload only, excluding the
+ * pseudo header, the port numbers and the checksum itself.  This
+ * costs a constant amount of work instead of a pass over the payload.
+ *
+ * @param af address family of the addresses (AF_INET or AF_INET6)
+ * @param source_ip source address of the segment
+ * @param destination_ip destination address of the segment
+ * @param tcp TCP header with the checksum to convert
+ * @param tcp_length number of bytes in the TCP header and payload
+ * @return partial sum, never 0
+ */
+uint16_t
+GNUNET_TUN_tcp_checksum_to_partial (int af,
+                                    const void *source_ip,
+                                    const void *destination_ip,
+                                    const struct GNUNET_TUN_TcpHeader *tcp,
+                                    uint16_t tcp_length)
+{
+  uint16_t partial;
+
+  /* checksum = ~(pseudo + ports + partial), so
+     partial = ~checksum - (pseudo + ports) */
+  partial = fold_sum ((uint32_t) (uint16_t) ~tcp->crc
+                      + (uint16_t) ~fold_sum (tcp_pseudo_sum (af,
+                                                              source_ip,
+                                                              destination_ip,
+                                                              tcp,
+                                                              tcp_length)));
+  /* 0x0000 and 0xFFFF are the same value, we use 0 for 'none' */
+  if (0 == partial)
+    partial = 0xFFFF;
+  return partial;
+}
+
+
+/**
+ * Calculate the TCP checksum from a partial sum as produced by
+ * #GNUNET_TUN_tcp_checksum_to_partial() for the same header (except
+ * for the port numbers) and payload.  The payload itself is not
+ * needed.
+ *
+ * @param af address family of the addresses (AF_INET or AF_INET6)
+ * @param source_ip source address of the segment
+ * @param destination_ip destination address of the segment
+ * @param tcp TCP header (initialized except for CRC)
+ * @param tcp_length number of bytes in the TCP header and payload
+ * @param partial partial sum over the header and payload
+ */
+void
+GNUNET_TUN_calculate_tcp_checksum_from_partial (int af,
+                                                const void *source_ip,
+                                                const void *destination_ip,
+                                                struct GNUNET_TUN_TcpHeader *tcp,
+                                                uint16_t tcp_length,
+                                                uint16_t partial)
+{
+  tcp->crc = GNUNET_CRYPTO_crc16_finish (tcp_pseudo_sum (af,
+                                                         source_ip,
+                                                         destination_ip,
+                                                         tcp,
+                                                         tcp_length)
+                                         + partial);
+}
+
+
 /**
  * Calculate IPv4 UDP checksum.
  *
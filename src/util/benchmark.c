@@ -0,0 +1,540 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file util/benchmark.c
+ * @brief common harness for the perf_* programs
+ * @author Christian Grothoff
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_benchmark_lib.h"
+#include <gauger.h>
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-benchmark", __VA_ARGS__)
+
+/**
+ * Number of warmup repetitions unless overridden in the environment.
+ */
+#define DEFAULT_WARMUP 1
+
+
+/**
+ * Measurements of one benchmark.
+ */
+struct Benchmark
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct Benchmark *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct Benchmark *prev;
+
+  /**
+   * Name of the benchmark.
+   */
+  char *name;
+
+  /**
+   * Unit of the work.
+   */
+  char *unit;
+
+  /**
+   * Time each repetition took, in microseconds.
+   */
+  uint64_t *samples;
+
+  /**
+   * Number of entries in @e samples.
+   */
+  unsigned int samples_len;
+
+  /**
+   * Total work done in all repetitions.
+   */
+  uint64_t work;
+};
+
+
+/**
+ * Handle for a suite of benchmarks.
+ */
+struct GNUNET_BENCHMARK_Suite
+{
+  /**
+   * Benchmarks in the order they were run.
+   */
+  struct Benchmark *head;
+
+  /**
+   * Benchmarks in the order they were run.
+   */
+  struct Benchmark *tail;
+
+  /**
+   * Gauger category.
+   */
+  char *category;
+
+  /**
+   * Name of the suite.
+   */
+  char *name;
+};
+
+
+/**
+ * Get a non-negative number from the environment.
+ *
+ * @param var name of the environment variable
+ * @param def value to use if @a var is not set or malformed
+ * @return the number
+ */
+static unsigned int
+get_env_number (const char *var,
+                unsigned int def)
+{
+  const char *val;
+  unsigned int ret;
+  char dummy;
+
+  val = getenv (var);
+  if (NULL == val)
+    return def;
+  if (1 != sscanf (val, "%u%c", &ret, &dummy))
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Ignoring malformed value `%s' of `%s'\n"),
+         val,
+         var);
+    return def;
+  }
+  return ret;
+}
+
+
+/**
+ * Create a benchmark suite.
+ *
+ * @param category gauger category of the results (i.e. "UTIL")
+ * @param name name of the suite, usually the name of the program
+ * @return handle for the suite
+ */
+struct GNUNET_BENCHMARK_Suite *
+GNUNET_BENCHMARK_suite_create (const char *category,
+                               const char *name)
+{
+  struct GNUNET_BENCHMARK_Suite *suite;
+
+  suite = GNUNET_new (struct GNUNET_BENCHMARK_Suite);
+  suite->category = GNUNET_strdup (category);
+  suite->name = GNUNET_strdup (name);
+  return suite;
+}
+
+
+/**
+ * Find the benchmark with the given name, create it if needed.
+ *
+ * @param suite suite to search
+ * @param name name of the benchmark
+ * @param unit unit of the work
+ * @return the benchmark
+ */
+static struct Benchmark *
+get_benchmark (struct GNUNET_BENCHMARK_Suite *suite,
+               const char *name,
+               const char *unit)
+{
+  struct Benchmark *b;
+
+  for (b = suite->head; NULL != b; b = b->next)
+    if (0 == strcmp (b->name, name))
+    {
+      GNUNET_break (0 == strcmp (b->unit, unit));
+      return b;
+    }
+  b = GNUNET_new (struct Benchmark);
+  b->name = GNUNET_strdup (name);
+  b->unit = GNUNET_strdup (unit);
+  GNUNET_CONTAINER_DLL_insert_tail (suite->head,
+                                    suite->tail,
+                                    b);
+  return b;
+}
+
+
+/**
+ * Add one measured repetition of a benchmark.
+ *
+ * @param suite suite the benchmark belongs to
+ * @param name name of the benchmark, also used as the gauger counter
+ * @param unit unit of @a work (i.e. "kb" or "ops")
+ * @param duration time the repetition took
+ * @param work amount of work done in the repetition
+ */
+void
+GNUNET_BENCHMARK_report (struct GNUNET_BENCHMARK_Suite *suite,
+                         const char *name,
+                         const char *unit,
+                         struct GNUNET_TIME_Relative duration,
+                         uint64_t work)
+{
+  struct Benchmark *b;
+  uint64_t us;
+
+  b = get_benchmark (suite, name, unit);
+  us = duration.rel_value_us;
+  GNUNET_array_append (b->samples,
+                       b->samples_len,
+                       us);
+  b->work += work;
+}
+
+
+/**
+ * Number of measured repetitions asynchronous benchmarks should do.
+ *
+ * @param repetitions default number of repetitions
+ * @return number of repetitions to do
+ */
+unsigned int
+GNUNET_BENCHMARK_get_repetitions (unsigned int repetitions)
+{
+  return GNUNET_MAX (1,
+                     get_env_number ("GNUNET_BENCHMARK_REPETITIONS",
+                                     repetitions));
+}
+
+
+/**
+ * Run a synchronous benchmark.
+ *
+ * @param suite suite the benchmark belongs to
+ * @param name name of the benchmark, also used as the gauger counter
+ * @param unit unit of the work returned by @a fn (i.e. "kb" or "ops")
+ * @param repetitions default number of measured repetitions
+ * @param fn function doing the work of one repetition
+ * @param fn_cls closure for @a fn
+ */
+void
+GNUNET_BENCHMARK_run (struct GNUNET_BENCHMARK_Suite *suite,
+                      const char *name,
+                      const char *unit,
+                      unsigned int repetitions,
+                      GNUNET_BENCHMARK_Function fn,
+                      void *fn_cls)
+{
+  struct GNUNET_TIME_Absolute start;
+  unsigned int warmup;
+  unsigned int i;
+  uint64_t work;
+
+  warmup = get_env_number ("GNUNET_BENCHMARK_WARMUP",
+                           DEFAULT_WARMUP);
+  repetitions = GNUNET_BENCHMARK_get_repetitions (repetitions);
+  for (i = 0; i < warmup; i++)
+    (void) fn (fn_cls);
+  for (i = 0; i < repetitions; i++)
+  {
+    start = GNUNET_TIME_absolute_get ();
+    work = fn (fn_cls);
+    GNUNET_BENCHMARK_report (suite,
+                             name,
+                             unit,
+                             GNUNET_TIME_absolute_get_duration (start),
+                             work);
+  }
+}
+
+
+/**
+ * Compare two samples, for qsort().
+ *
+ * @param a first sample
+ * @param b second sample
+ * @return -1, 0 or 1
+ */
+static int
+sample_cmp (const void *a,
+            const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+
+  if (x < y)
+    return -1;
+  if (x > y)
+    return 1;
+  return 0;
+}
+
+
+/**
+ * Get a percentile (nearest rank) of sorted samples.
+ *
+ * @param b benchmark with sorted samples
+ * @param pct percentile to get, 0-100
+ * @return the sample at the percentile
+ */
+static uint64_t
+get_percentile (const struct Benchmark *b,
+                unsigned int pct)
+{
+  unsigned int rank;
+
+  rank = (b->samples_len * pct + 99) / 100;
+  if (0 == rank)
+    rank = 1;
+  return b->samples[rank - 1];
+}
+
+
+/**
+ * Convert a number of microseconds to a string.
+ *
+ * @param us microseconds
+ * @return statically allocated string
+ */
+static const char *
+us_to_string (uint64_t us)
+{
+  struct GNUNET_TIME_Relative rel;
+
+  rel.rel_value_us = us;
+  return GNUNET_STRINGS_relative_time_to_string (rel,
+                                                 GNUNET_NO);
+}
+
+
+/**
+ * Write a string as a JSON string literal.
+ *
+ * @param f where to write
+ * @param str string to write
+ */
+static void
+write_json_string (FILE *f,
+                   const char *str)
+{
+  fputc ('"', f);
+  for (; '\0' != *str; str++)
+  {
+    if ( ('"' == *str) ||
+         ('\\' == *str) )
+      fprintf (f, "\\%c", *str);
+    else if ((unsigned char) *str < 0x20)
+      fprintf (f, "\\u%04x", (unsigned int) (unsigned char) *str);
+    else
+      fputc (*str, f);
+  }
+  fputc ('"', f);
+}
+
+
+/**
+ * Rate of a benchmark, in work per second based on the median
+ * repetition.
+ *
+ * @param b benchmark with sorted samples
+ * @return the rate
+ */
+static double
+get_rate (const struct Benchmark *b)
+{
+  return (double) b->work / b->samples_len * 1000LL * 1000LL
+    / (1 + get_percentile (b, 50));
+}
+
+
+/**
+ * Print the summary of a benchmark and report it to gauger.
+ *
+ * @param suite suite of the benchmark
+ * @param b benchmark with sorted samples
+ */
+static void
+print_benchmark (const struct GNUNET_BENCHMARK_Suite *suite,
+                 const struct Benchmark *b)
+{
+  char gauger_unit[strlen (b->unit) + 4];
+  double rate;
+
+  rate = get_rate (b);
+  fprintf (stdout,
+           "%s: %.2f %s/s (median %s, ",
+           b->name,
+           rate,
+           b->unit,
+           us_to_string (get_percentile (b, 50)));
+  fprintf (stdout,
+           "p99 %s, %u repetitions)\n",
+           us_to_string (get_percentile (b, 99)),
+           b->samples_len);
+  GNUNET_snprintf (gauger_unit,
+                   sizeof (gauger_unit),
+                   "%s/ms",
+                   b->unit);
+  GAUGER (suite->category, b->name, rate / 1000, gauger_unit);
+}
+
+
+/**
+ * Write the results of a benchmark as a JSON object.
+ *
+ * @param f where to write
+ * @param b benchmark with sorted samples
+ */
+static void
+write_json_benchmark (FILE *f,
+                      const struct Benchmark *b)
+{
+  uint64_t total;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < b->samples_len; i++)
+    total += b->samples[i];
+  fprintf (f, "{\"name\":");
+  write_json_string (f, b->name);
+  fprintf (f, ",\"unit\":");
+  write_json_string (f, b->unit);
+  fprintf (f,
+           ",\"repetitions\":%u,\"work\":%llu"
+           ",\"min_us\":%llu,\"median_us\":%llu,\"p90_us\":%llu"
+           ",\"p99_us\":%llu,\"max_us\":%llu,\"mean_us\":%llu"
+           ",\"rate_per_s\":%.3f}",
+           b->samples_len,
+           (unsigned long long) b->work,
+           (unsigned long long) b->samples[0],
+           (unsigned long long) get_percentile (b, 50),
+           (unsigned long long) get_percentile (b, 90),
+           (unsigned long long) get_percentile (b, 99),
+           (unsigned long long) b->samples[b->samples_len - 1],
+           (unsigned long long) (total / b->samples_len),
+           get_rate (b));
+}
+
+
+/**
+ * Append the results of a suite as one line of JSON to the file
+ * named in `GNUNET_BENCHMARK_JSON`.
+ *
+ * @param suite suite with sorted samples
+ * @return #GNUNET_OK on success
+ */
+static int
+write_json (const struct GNUNET_BENCHMARK_Suite *suite)
+{
+  const struct Benchmark *b;
+  const char *fn;
+  FILE *f;
+
+  fn = getenv ("GNUNET_BENCHMARK_JSON");
+  if (NULL == fn)
+    return GNUNET_OK;
+  if (0 == strcmp (fn, "-"))
+    f = stdout;
+  else if (NULL == (f = FOPEN (fn, "a")))
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Failed to open `%s' for writing: %s\n"),
+         fn,
+         STRERROR (errno));
+    return GNUNET_SYSERR;
+  }
+  fprintf (f, "{\"suite\":");
+  write_json_string (f, suite->name);
+  fprintf (f, ",\"category\":");
+  write_json_string (f, suite->category);
+  fprintf (f,
+           ",\"version\":\"%s\",\"timestamp_us\":%llu,\"results\":[",
+           PACKAGE_VERSION,
+           (unsigned long long) GNUNET_TIME_absolute_get ().abs_value_us);
+  for (b = suite->head; NULL != b; b = b->next)
+  {
+    write_json_benchmark (f, b);
+    if (NULL != b->next)
+      fputc (',', f);
+  }
+  fprintf (f, "]}\n");
+  if (stdout == f)
+  {
+    fflush (f);
+    return GNUNET_OK;
+  }
+  if (0 != FCLOSE (f))
+  {
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Failed to write `%s': %s\n"),
+         fn,
+         STRERROR (errno));
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Summarize and output the results of all benchmarks of a suite,
+ * then free it.
+ *
+ * @param suite suite to finish
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the JSON
+ *         output could not be written
+ */
+int
+GNUNET_BENCHMARK_suite_destroy (struct GNUNET_BENCHMARK_Suite *suite)
+{
+  struct Benchmark *b;
+  int ret;
+
+  for (b = suite->head; NULL != b; b = b->next)
+  {
+    qsort (b->samples,
+           b->samples_len,
+           sizeof (uint64_t),
+           &sample_cmp);
+    print_benchmark (suite, b);
+  }
+  ret = write_json (suite);
+  while (NULL != (b = suite->head))
+  {
+    GNUNET_CONTAINER_DLL_remove (suite->head,
+                                 suite->tail,
+                                 b);
+    GNUNET_free (b->samples);
+    GNUNET_free (b->name);
+    GNUNET_free (b->unit);
+    GNUNET_free (b);
+  }
+  GNUNET_free (suite->category);
+  GNUNET_free (suite->name);
+  GNUNET_free (suite);
+  return ret;
+}
+
+
+/* end of benchmark.c */
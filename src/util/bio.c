@@ -56,10 +56,27 @@ struct GNUNET_BIO_ReadHandle
   char *emsg;
 
   /**
-   * I/O buffer.  Allocated at the end of the struct, do not free!
+   * Mapping of the file, NULL if we read through the buffer.
+   */
+  struct GNUNET_DISK_MapHandle *map;
+
+  /**
+   * I/O buffer.  Allocated at the end of the struct or the
+   * start of the file mapping, do not free!
    */
   char *buffer;
 
+  /**
+   * Buffer for spans that are not contiguous in @e buffer,
+   * NULL if not needed so far.
+   */
+  char *span;
+
+  /**
+   * Allocated size of @e span.
+   */
+  size_t span_size;
+
   /**
    * Number of bytes available in read @e buffer.
    */
@@ -88,10 +105,30 @@ GNUNET_BIO_read_open (const char *fn)
 {
   struct GNUNET_DISK_FileHandle *fd;
   struct GNUNET_BIO_ReadHandle *h;
+  struct GNUNET_DISK_MapHandle *map;
+  off_t fsize;
+  void *addr;
 
   fd = GNUNET_DISK_file_open (fn, GNUNET_DISK_OPEN_READ, GNUNET_DISK_PERM_NONE);
   if (NULL == fd)
     return NULL;
+  /* map the whole file if we can, so reading is just copying
+     from (or pointing into) the mapping */
+  if ( (GNUNET_OK == GNUNET_DISK_file_handle_size (fd, &fsize)) &&
+       (fsize > 0) &&
+       (fsize == (off_t) (size_t) fsize) &&
+       (NULL != (addr = GNUNET_DISK_file_map (fd, &map,
+                                              GNUNET_DISK_MAP_TYPE_READ,
+                                              (size_t) fsize))) )
+  {
+    h = GNUNET_new (struct GNUNET_BIO_ReadHandle);
+    h->map = map;
+    h->buffer = addr;
+    h->size = (size_t) fsize;
+    h->have = (size_t) fsize;
+    h->fd = fd;
+    return h;
+  }
   h = GNUNET_malloc (sizeof (struct GNUNET_BIO_ReadHandle) + BIO_BUFFER_SIZE);
   h->buffer = (char *) &h[1];
   h->size = BIO_BUFFER_SIZE;
@@ -119,7 +156,10 @@ GNUNET_BIO_read_close (struct GNUNET_BIO_ReadHandle *h,
     *emsg = h->emsg;
   else
     GNUNET_free_non_null (h->emsg);
+  if (NULL != h->map)
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (h->map));
   GNUNET_DISK_file_close (h->fd);
+  GNUNET_free_non_null (h->span);
   GNUNET_free (h);
   return err;
 }
@@ -163,7 +203,10 @@ GNUNET_BIO_read (struct GNUNET_BIO_ReadHandle *h,
       return GNUNET_OK;         /* done! */
     GNUNET_assert (h->have == h->pos);
     /* fill buffer */
-    ret = GNUNET_DISK_file_read (h->fd, h->buffer, h->size);
+    if (NULL != h->map)
+      ret = 0;                  /* the mapping is the whole file */
+    else
+      ret = GNUNET_DISK_file_read (h->fd, h->buffer, h->size);
     if (-1 == ret)
     {
       GNUNET_asprintf (&h->emsg,
@@ -207,11 +250,68 @@ GNUNET_BIO_read_fn (struct GNUNET_BIO_ReadHandle *h,
 {
   char what[1024];
 
+  /* fast path, the location is only needed for error messages */
+  if ( (NULL == h->emsg) &&
+       (h->have - h->pos >= len) )
+  {
+    memcpy (result, &h->buffer[h->pos], len);
+    h->pos += len;
+    return GNUNET_OK;
+  }
   GNUNET_snprintf (what, sizeof (what), "%s:%d", file, line);
   return GNUNET_BIO_read (h, what, result, len);
 }
 
 
+/**
+ * Read @a len bytes from a file without copying them into a buffer
+ * of the caller.  If the file is mapped into memory, @a result
+ * points into the mapping; otherwise it points into a buffer of
+ * the handle.
+ *
+ * @param h handle to an open file
+ * @param what describes what is being read (for error message creation)
+ * @param result set to the data read, valid until the next read
+ *        from @a h or until it is closed
+ * @param len the number of bytes to read
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on failure
+ */
+int
+GNUNET_BIO_read_span (struct GNUNET_BIO_ReadHandle *h,
+                      const char *what,
+                      const void **result,
+                      size_t len)
+{
+  if (NULL != h->emsg)
+    return GNUNET_SYSERR;
+  if (h->have - h->pos >= len)
+  {
+    *result = &h->buffer[h->pos];
+    h->pos += len;
+    return GNUNET_OK;
+  }
+  if (h->span_size < len)
+  {
+    GNUNET_free_non_null (h->span);
+    h->span = GNUNET_malloc_large (len);
+    if (NULL == h->span)
+    {
+      h->span_size = 0;
+      GNUNET_asprintf (&h->emsg,
+                       _("Error reading `%s': %s"),
+                       what,
+                       STRERROR (errno));
+      return GNUNET_SYSERR;
+    }
+    h->span_size = len;
+  }
+  if (GNUNET_OK != GNUNET_BIO_read (h, what, h->span, len))
+    return GNUNET_SYSERR;
+  *result = h->span;
+  return GNUNET_OK;
+}
+
+
 /**
  * Read 0-terminated string from a file.
  *
@@ -277,7 +377,7 @@ GNUNET_BIO_read_meta_data (struct GNUNET_BIO_ReadHandle *h,
                            struct GNUNET_CONTAINER_MetaData **result)
 {
   uint32_t size;
-  char *buf;
+  const void *buf;
   struct GNUNET_CONTAINER_MetaData *meta;
 
   if (GNUNET_BIO_read_int32 (h, (int32_t *) & size) != GNUNET_OK)
@@ -294,20 +394,14 @@ GNUNET_BIO_read_meta_data (struct GNUNET_BIO_ReadHandle *h,
                      what, size, MAX_META_DATA);
     return GNUNET_SYSERR;
   }
-  buf = GNUNET_malloc (size);
-  if (GNUNET_OK != GNUNET_BIO_read (h, what, buf, size))
-  {
-    GNUNET_free (buf);
+  if (GNUNET_OK != GNUNET_BIO_read_span (h, what, &buf, size))
     return GNUNET_SYSERR;
-  }
   meta = GNUNET_CONTAINER_meta_data_deserialize (buf, size);
   if (meta == NULL)
   {
-    GNUNET_free (buf);
     GNUNET_asprintf (&h->emsg, _("Metadata `%s' failed to deserialize"), what);
     return GNUNET_SYSERR;
   }
-  GNUNET_free (buf);
   *result = meta;
   return GNUNET_OK;
 }
@@ -61,6 +61,17 @@ struct GNUNET_CLIENT_TransmitHandle
    */
   void *notify_cls;
 
+  /**
+   * Function to call once the messages passed to
+   * #GNUNET_CLIENT_transmit_messages() were transmitted.
+   */
+  GNUNET_CONNECTION_TransmitContinuation cont;
+
+  /**
+   * Closure for @e cont.
+   */
+  void *cont_cls;
+
   /**
    * Handle to the transmission with the underlying
    * connection.
@@ -100,6 +111,12 @@ struct GNUNET_CLIENT_TransmitHandle
 };
 
 
+/**
+ * Pool the `struct GNUNET_CLIENT_TransmitHandle`s are allocated from.
+ */
+static struct GNUNET_MemoryPool *transmit_pool;
+
+
 /**
  * Context for processing
  * "GNUNET_CLIENT_transmit_and_get_response" requests.
@@ -274,6 +291,9 @@ try_unixpath (const char *service_name,
     {
       LOG (GNUNET_ERROR_TYPE_DEBUG, "Connected to unixpath `%s'!\n",
 	   unixpath);
+      if (GNUNET_YES ==
+          GNUNET_CONFIGURATION_get_value_yesno (cfg, service_name, "SHM_IPC"))
+        GNUNET_CONNECTION_shm_offer_ (connection);
       GNUNET_free (unixpath);
       return connection;
     }
@@ -1095,7 +1115,7 @@ client_delayed_retry (void *cls,
     /* give up, was shutdown */
     th->client->th = NULL;
     th->notify (th->notify_cls, 0, NULL);
-    GNUNET_free (th);
+    GNUNET_pool_free (transmit_pool, th);
     return;
   }
   th->client->connection =
@@ -1129,7 +1149,7 @@ client_delayed_retry (void *cls,
     GNUNET_break (0);
     th->client->th = NULL;
     th->notify (th->notify_cls, 0, NULL);
-    GNUNET_free (th);
+    GNUNET_pool_free (transmit_pool, th);
     return;
   }
 }
@@ -1172,7 +1192,7 @@ client_notify (void *cls,
            MAX_ATTEMPTS - th->attempts_left);
       GNUNET_break (0 ==
                     th->notify (th->notify_cls, 0, NULL));
-      GNUNET_free (th);
+      GNUNET_pool_free (transmit_pool, th);
       return 0;
     }
     /* auto-retry */
@@ -1204,7 +1224,7 @@ client_notify (void *cls,
   }
   GNUNET_assert (size >= th->size);
   ret = th->notify (th->notify_cls, size, buf);
-  GNUNET_free (th);
+  GNUNET_pool_free (transmit_pool, th);
   if (sizeof (struct GNUNET_MessageHeader) <= ret)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -1253,7 +1273,7 @@ GNUNET_CLIENT_notify_transmit_ready (struct GNUNET_CLIENT_Connection *client,
     GNUNET_assert (0);
     return NULL;
   }
-  th = GNUNET_new (struct GNUNET_CLIENT_TransmitHandle);
+  th = GNUNET_pool_new (transmit_pool, struct GNUNET_CLIENT_TransmitHandle);
   th->client = client;
   th->size = size;
   th->timeout = GNUNET_TIME_relative_to_absolute (timeout);
@@ -1283,7 +1303,7 @@ GNUNET_CLIENT_notify_transmit_ready (struct GNUNET_CLIENT_Connection *client,
     if (NULL == th->th)
     {
       GNUNET_break (0);
-      GNUNET_free (th);
+      GNUNET_pool_free (transmit_pool, th);
       client->th = NULL;
       return NULL;
     }
@@ -1312,7 +1332,83 @@ GNUNET_CLIENT_notify_transmit_ready_cancel (struct GNUNET_CLIENT_TransmitHandle
     GNUNET_CONNECTION_notify_transmit_ready_cancel (th->th);
   }
   th->client->th = NULL;
-  GNUNET_free (th);
+  GNUNET_pool_free (transmit_pool, th);
+}
+
+
+/**
+ * Continuation for #GNUNET_CLIENT_transmit_messages().
+ *
+ * @param cls the `struct GNUNET_CLIENT_TransmitHandle`
+ * @param result #GNUNET_OK if the messages were transmitted
+ */
+static void
+client_transmit_messages_cont (void *cls,
+                               int result)
+{
+  struct GNUNET_CLIENT_TransmitHandle *th = cls;
+  GNUNET_CONNECTION_TransmitContinuation cont = th->cont;
+  void *cont_cls = th->cont_cls;
+
+  th->client->th = NULL;
+  GNUNET_pool_free (transmit_pool, th);
+  cont (cont_cls, result);
+}
+
+
+/**
+ * Transmit messages to the service without copying them.  Unlike
+ * #GNUNET_CLIENT_notify_transmit_ready(), this never (re)connects or
+ * retries; it is only available once the connection is established,
+ * and the caller should fall back to
+ * #GNUNET_CLIENT_notify_transmit_ready() if NULL is returned.  The
+ * messages must remain valid until @a cont is called or the request is
+ * cancelled using #GNUNET_CLIENT_notify_transmit_ready_cancel().
+ *
+ * @param client connection to the service
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up (and call
+ *        @a cont with #GNUNET_SYSERR)?
+ * @param cont function to call once the messages were transmitted
+ * @param cont_cls closure for @a cont
+ * @return NULL if the messages cannot be transmitted this way
+ *         right now, otherwise a handle to cancel the request
+ */
+struct GNUNET_CLIENT_TransmitHandle *
+GNUNET_CLIENT_transmit_messages (struct GNUNET_CLIENT_Connection *client,
+                                 const struct GNUNET_MessageHeader *const *msgs,
+                                 unsigned int count,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_CONNECTION_TransmitContinuation cont,
+                                 void *cont_cls)
+{
+  struct GNUNET_CLIENT_TransmitHandle *th;
+
+  if ( (NULL != client->th) ||
+       (NULL == client->connection) ||
+       (GNUNET_YES == client->first_message) )
+    return NULL;
+  th = GNUNET_pool_new (transmit_pool, struct GNUNET_CLIENT_TransmitHandle);
+  th->client = client;
+  th->timeout = GNUNET_TIME_relative_to_absolute (timeout);
+  th->cont = cont;
+  th->cont_cls = cont_cls;
+  th->th = GNUNET_CONNECTION_transmit_messages (client->connection,
+                                                msgs,
+                                                count,
+                                                timeout,
+                                                &client_transmit_messages_cont,
+                                                th);
+  if (NULL == th->th)
+  {
+    GNUNET_break (0);
+    GNUNET_pool_free (transmit_pool, th);
+    return NULL;
+  }
+  client->th = th;
+  return th;
 }
 
 
@@ -257,6 +257,181 @@ GNUNET_xfree_ (void *ptr,
 }
 
 
+/**
+ * Number of bytes a pool keeps on its free list (at least
+ * #POOL_MIN_FREE blocks).
+ */
+#define POOL_FREE_BYTES (256 * 1024)
+
+/**
+ * Minimum number of blocks a pool keeps on its free list.
+ */
+#define POOL_MIN_FREE 16
+
+
+/**
+ * Free block of a pool.
+ */
+struct PoolBlock
+{
+  /**
+   * Next free block.
+   */
+  struct PoolBlock *next;
+};
+
+
+/**
+ * Pool of memory blocks of a fixed size.
+ */
+struct GNUNET_MemoryPool
+{
+  /**
+   * Head of the list of free blocks.
+   */
+  struct PoolBlock *free_head;
+
+  /**
+   * Size of the blocks of this pool.
+   */
+  size_t size;
+
+  /**
+   * Number of blocks in the @e free_head list.
+   */
+  unsigned int free_count;
+
+  /**
+   * Maximum number of blocks we keep in the @e free_head list.
+   */
+  unsigned int max_free;
+
+  /**
+   * Number of blocks currently handed out.
+   */
+  unsigned int used_count;
+};
+
+
+/**
+ * Allocate memory from a pool, creating the pool if needed.
+ *
+ * @param pool the pool to allocate from, created if *pool is NULL
+ * @param size number of bytes to allocate
+ * @param filename where in the code was the call to GNUNET_pool_malloc()
+ * @param linenumber where in the code was the call to GNUNET_pool_malloc()
+ * @return allocated memory, never NULL
+ */
+void *
+GNUNET_xpool_malloc_ (struct GNUNET_MemoryPool **pool,
+                      size_t size,
+                      const char *filename,
+                      int linenumber)
+{
+  struct GNUNET_MemoryPool *mp;
+  struct PoolBlock *block;
+
+  if (NULL == (mp = *pool))
+  {
+    mp = GNUNET_xmalloc_ (sizeof (struct GNUNET_MemoryPool),
+                          filename,
+                          linenumber);
+    mp->size = GNUNET_MAX (size,
+                           sizeof (struct PoolBlock));
+    mp->max_free = GNUNET_MAX (POOL_FREE_BYTES / mp->size,
+                               POOL_MIN_FREE);
+    *pool = mp;
+  }
+  GNUNET_assert_at (size <= mp->size,
+                    filename,
+                    linenumber);
+  mp->used_count++;
+  if (NULL == (block = mp->free_head))
+    return GNUNET_xmalloc_ (mp->size,
+                            filename,
+                            linenumber);
+  mp->free_head = block->next;
+  mp->free_count--;
+  memset (block, 0, mp->size);
+  return block;
+}
+
+
+/**
+ * Return memory to a pool.  The block is kept for reuse unless the
+ * free list of the pool is full.
+ *
+ * @param pool the pool @a ptr was allocated from
+ * @param ptr pointer to memory to free
+ * @param filename where in the code was the call to GNUNET_pool_free()
+ * @param linenumber where in the code was the call to GNUNET_pool_free()
+ */
+void
+GNUNET_xpool_free_ (struct GNUNET_MemoryPool *pool,
+                    void *ptr,
+                    const char *filename,
+                    int linenumber)
+{
+  struct PoolBlock *block = ptr;
+
+  GNUNET_assert_at (NULL != pool,
+                    filename,
+                    linenumber);
+  GNUNET_assert_at (NULL != ptr,
+                    filename,
+                    linenumber);
+  GNUNET_assert_at (0 < pool->used_count,
+                    filename,
+                    linenumber);
+  pool->used_count--;
+  if (pool->free_count >= pool->max_free)
+  {
+    GNUNET_xfree_ (ptr,
+                   filename,
+                   linenumber);
+    return;
+  }
+#if ENABLE_POISONING
+  memset (ptr, 0xBA, pool->size);
+#endif
+  block->next = pool->free_head;
+  pool->free_head = block;
+  pool->free_count++;
+}
+
+
+/**
+ * Destroy a pool, releasing all blocks on its free list.
+ *
+ * @param pool the pool to destroy, may be NULL
+ * @param filename where in the code was the call to GNUNET_pool_destroy()
+ * @param linenumber where in the code was the call to GNUNET_pool_destroy()
+ */
+void
+GNUNET_xpool_destroy_ (struct GNUNET_MemoryPool *pool,
+                       const char *filename,
+                       int linenumber)
+{
+  struct PoolBlock *block;
+
+  if (NULL == pool)
+    return;
+  GNUNET_assert_at (0 == pool->used_count,
+                    filename,
+                    linenumber);
+  while (NULL != (block = pool->free_head))
+  {
+    pool->free_head = block->next;
+    GNUNET_xfree_ (block,
+                   filename,
+                   linenumber);
+  }
+  GNUNET_xfree_ (pool,
+                 filename,
+                 linenumber);
+}
+
+
 /**
  * Dup a string (same semantics as strdup).
  *
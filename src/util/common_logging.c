@@ -27,6 +27,13 @@
 #include "gnunet_crypto_lib.h"
 #include "gnunet_strings_lib.h"
 #include <regex.h>
+#if HAVE_PTHREAD && !WINDOWS
+#include <pthread.h>
+/**
+ * Do we support writing the log in a background thread?
+ */
+#define ASYNC_LOG 1
+#endif
 
 
 /**
@@ -72,6 +79,11 @@
 #define PATH_MAX 4096
 #endif
 
+/**
+ * Size of the ring buffer for asynchronous logging.
+ */
+#define ASYNC_BUFFER_SIZE (1024 * 1024)
+
 
 /**
  * Linked list of active loggers.
@@ -156,6 +168,50 @@ int skip_log = 0;
  */
 static FILE *GNUNET_stderr;
 
+#if ASYNC_LOG
+/**
+ * Ring buffer with formatted log lines for the writer thread,
+ * NULL if we log synchronously.
+ */
+static char *async_buf;
+
+/**
+ * Total number of bytes ever added to #async_buf.
+ */
+static uint64_t async_head;
+
+/**
+ * Total number of bytes ever written out from #async_buf.
+ */
+static uint64_t async_tail;
+
+/**
+ * Number of lines dropped because #async_buf was full, not yet
+ * reported in the log.
+ */
+static unsigned long long async_dropped;
+
+/**
+ * Is the writer thread currently writing?
+ */
+static int async_writing;
+
+/**
+ * Protects the ring buffer state.
+ */
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when there is something to write.
+ */
+static pthread_cond_t async_work_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Signalled when the writer thread finished writing.
+ */
+static pthread_cond_t async_done_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
 /**
  * Represents a single logging definition
  */
@@ -278,12 +334,168 @@ resize_logdefs ()
 }
 
 
+#if ASYNC_LOG
+/**
+ * Main function of the log writer thread.
+ *
+ * @param cls NULL
+ * @return never
+ */
+static void *
+async_writer (void *cls)
+{
+  unsigned long long dropped;
+  size_t off;
+  size_t len;
+  FILE *out;
+
+  GNUNET_assert (0 == pthread_mutex_lock (&async_lock));
+  while (1)
+  {
+    while ( (async_head == async_tail) &&
+            (0 == async_dropped) )
+      GNUNET_assert (0 == pthread_cond_wait (&async_work_cond, &async_lock));
+    off = async_tail % ASYNC_BUFFER_SIZE;
+    len = GNUNET_MIN (async_head - async_tail,
+                      (uint64_t) (ASYNC_BUFFER_SIZE - off));
+    dropped = async_dropped;
+    async_dropped = 0;
+    out = GNUNET_stderr;
+    async_writing = GNUNET_YES;
+    GNUNET_assert (0 == pthread_mutex_unlock (&async_lock));
+    /* producers never touch [tail, head), so we can write it
+       without holding the lock */
+    if (NULL != out)
+    {
+      if (0 != len)
+        (void) fwrite (&async_buf[off], 1, len, out);
+      if (0 != dropped)
+        FPRINTF (out, "%llu log messages dropped\n", dropped);
+      fflush (out);
+    }
+    GNUNET_assert (0 == pthread_mutex_lock (&async_lock));
+    async_tail += len;
+    async_writing = GNUNET_NO;
+    GNUNET_assert (0 == pthread_cond_broadcast (&async_done_cond));
+  }
+  return NULL;
+}
+
+
+/**
+ * Wait until the writer thread wrote out everything logged so far.
+ */
+static void
+async_flush ()
+{
+  if (NULL == async_buf)
+    return;
+  GNUNET_assert (0 == pthread_mutex_lock (&async_lock));
+  while ( (async_head != async_tail) ||
+          (0 != async_dropped) ||
+          (GNUNET_YES == async_writing) )
+    GNUNET_assert (0 == pthread_cond_wait (&async_done_cond, &async_lock));
+  GNUNET_assert (0 == pthread_mutex_unlock (&async_lock));
+}
+
+
+/**
+ * After a fork(), the writer thread only exists in the parent,
+ * so the child has to log synchronously.
+ */
+static void
+async_atfork_child ()
+{
+  pthread_mutex_t fresh = PTHREAD_MUTEX_INITIALIZER;
+
+  async_lock = fresh;
+  async_buf = NULL;
+}
+
+
+/**
+ * Start writing the log in a background thread.
+ */
+static void
+async_start ()
+{
+  pthread_t thread;
+  char *buf;
+
+  if (NULL != async_buf)
+    return;
+  buf = malloc (ASYNC_BUFFER_SIZE);
+  if (NULL == buf)
+    return;
+  async_buf = buf;
+  if (0 != pthread_create (&thread, NULL, &async_writer, NULL))
+  {
+    async_buf = NULL;
+    free (buf);
+    return;
+  }
+  (void) pthread_detach (thread);
+  (void) pthread_atfork (NULL, NULL, &async_atfork_child);
+}
+
+
+/**
+ * Queue a log line for the writer thread.  Drops the line if the
+ * ring buffer is full.
+ *
+ * @param kind how severe was the issue
+ * @param comp component responsible
+ * @param datestr current date/time
+ * @param msg the actual message
+ */
+static void
+async_output (enum GNUNET_ErrorType kind, const char *comp,
+              const char *datestr, const char *msg)
+{
+  const char *type = GNUNET_error_type_to_string (kind);
+  size_t len;
+  size_t off;
+  size_t first;
+  int ret;
+
+  ret = snprintf (NULL, 0, "%s %s %s %s", datestr, comp, type, msg);
+  if (ret < 0)
+    return;
+  len = ret;
+  {
+    char line[len + 1];
+
+    snprintf (line, sizeof (line), "%s %s %s %s", datestr, comp, type, msg);
+    GNUNET_assert (0 == pthread_mutex_lock (&async_lock));
+    if (ASYNC_BUFFER_SIZE - (async_head - async_tail) < len)
+    {
+      async_dropped++;
+    }
+    else
+    {
+      off = async_head % ASYNC_BUFFER_SIZE;
+      first = GNUNET_MIN (len, ASYNC_BUFFER_SIZE - off);
+      memcpy (&async_buf[off], line, first);
+      memcpy (async_buf, &line[first], len - first);
+      async_head += len;
+    }
+    GNUNET_assert (0 == pthread_cond_signal (&async_work_cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&async_lock));
+  }
+}
+#endif
+
+
 /**
  * Abort the process, generate a core dump if possible.
  */
 void
 GNUNET_abort_ ()
 {
+#if ASYNC_LOG
+  /* make sure the reason for the abort made it to the log */
+  async_flush ();
+#endif
 #if WINDOWS
   DebugBreak ();
 #endif
@@ -350,6 +562,10 @@ setup_log_file (const struct tm *tm)
   }
   if (0 == strcmp (fn, last_fn))
     return GNUNET_OK; /* no change */
+#if ASYNC_LOG
+  /* the writer thread must be done with the old file */
+  async_flush ();
+#endif
   log_rotate (last_fn);
   strcpy (last_fn, fn);
 #if WINDOWS
@@ -680,6 +896,12 @@ GNUNET_log_setup (const char *comp,
   GNUNET_free_non_null (component_nopid);
   component_nopid = GNUNET_strdup (comp);
 
+#if ASYNC_LOG
+  if ( (NULL != getenv ("GNUNET_LOG_ASYNC")) &&
+       (0 != strcasecmp (getenv ("GNUNET_LOG_ASYNC"), "NO")) &&
+       ('\0' != getenv ("GNUNET_LOG_ASYNC")[0]) )
+    async_start ();
+#endif
   env_logfile = getenv ("GNUNET_FORCE_LOGFILE");
   if ((NULL != env_logfile) && (strlen (env_logfile) > 0))
     logfile = env_logfile;
@@ -762,6 +984,11 @@ output_message (enum GNUNET_ErrorType kind, const char *comp,
   struct CustomLogger *pos;
 #if WINDOWS
   EnterCriticalSection (&output_message_cs);
+#endif
+#if ASYNC_LOG
+  if (NULL != async_buf)
+    async_output (kind, comp, datestr, msg);
+  else
 #endif
   if (NULL != GNUNET_stderr)
   {
@@ -1050,11 +1277,14 @@ GNUNET_error_type_to_string (enum GNUNET_ErrorType kind)
 const char *
 GNUNET_h2s (const struct GNUNET_HashCode * hc)
 {
-  static struct GNUNET_CRYPTO_HashAsciiEncoded ret;
+  static char buf[9];
+  char *end;
 
-  GNUNET_CRYPTO_hash_to_enc (hc, &ret);
-  ret.encoding[8] = '\0';
-  return (const char *) ret.encoding;
+  /* the first 5 bytes yield exactly the first 8 characters */
+  end = GNUNET_STRINGS_data_to_string (hc, 5, buf, 8);
+  GNUNET_assert (NULL != end);
+  *end = '\0';
+  return buf;
 }
 
 
@@ -1089,12 +1319,12 @@ GNUNET_h2s_full (const struct GNUNET_HashCode * hc)
 const char *
 GNUNET_i2s (const struct GNUNET_PeerIdentity *pid)
 {
-  static char buf[256];
-  char *ret;
+  static char buf[6];
+  char *end;
 
-  ret = GNUNET_CRYPTO_eddsa_public_key_to_string (&pid->public_key);
-  strcpy (buf, ret);
-  GNUNET_free (ret);
+  /* the first 3 bytes cover the first 4 characters */
+  end = GNUNET_STRINGS_data_to_string (&pid->public_key, 3, buf, 5);
+  GNUNET_assert (NULL != end);
   buf[4] = '\0';
   return buf;
 }
@@ -1112,12 +1342,15 @@ GNUNET_i2s (const struct GNUNET_PeerIdentity *pid)
 const char *
 GNUNET_i2s_full (const struct GNUNET_PeerIdentity *pid)
 {
-  static char buf[256];
-  char *ret;
-
-  ret = GNUNET_CRYPTO_eddsa_public_key_to_string (&pid->public_key);
-  strcpy (buf, ret);
-  GNUNET_free (ret);
+  static char buf[(sizeof (struct GNUNET_PeerIdentity) * 8 + 4) / 5 + 1];
+  char *end;
+
+  end = GNUNET_STRINGS_data_to_string (&pid->public_key,
+                                       sizeof (pid->public_key),
+                                       buf,
+                                       sizeof (buf) - 1);
+  GNUNET_assert (NULL != end);
+  *end = '\0';
   return buf;
 }
 
@@ -1260,6 +1493,9 @@ GNUNET_util_cl_init ()
 void __attribute__ ((destructor))
 GNUNET_util_cl_fini ()
 {
+#if ASYNC_LOG
+  async_flush ();
+#endif
 #if WINDOWS
   DeleteCriticalSection (&output_message_cs);
 #endif
@@ -27,6 +27,7 @@
 #include "platform.h"
 #include "gnunet_crypto_lib.h"
 #include "gnunet_strings_lib.h"
+#include "gnunet_container_lib.h"
 #include "gnunet_configuration_lib.h"
 #include "gnunet_disk_lib.h"
 
@@ -54,6 +55,11 @@ struct ConfigEntry
    * current, commited value
    */
   char *val;
+
+  /**
+   * #name_hash() of @e key.
+   */
+  uint32_t hash;
 };
 
 
@@ -76,6 +82,11 @@ struct ConfigSection
    * name of the section
    */
   char *name;
+
+  /**
+   * #name_hash() of @e name.
+   */
+  uint32_t hash;
 };
 
 
@@ -89,6 +100,11 @@ struct GNUNET_CONFIGURATION_Handle
    */
   struct ConfigSection *sections;
 
+  /**
+   * Index of @e sections by #name_hash() of their name.
+   */
+  struct GNUNET_CONTAINER_MultiHashMap32 *section_map;
+
   /**
    * Modification indication since last save
    * #GNUNET_NO if clean, #GNUNET_YES if dirty,
@@ -111,6 +127,120 @@ struct DiffHandle
 };
 
 
+/**
+ * Compute a case-insensitive hash of a section or option name, so
+ * that lookups only need to compare strings on a hash match.
+ *
+ * @param name name to hash
+ * @return FNV-1a hash over the lower-case @a name
+ */
+static uint32_t
+name_hash (const char *name)
+{
+  uint32_t hash;
+
+  hash = 2166136261U;
+  while ('\0' != *name)
+  {
+    hash ^= (uint32_t) tolower ((unsigned char) *name++);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+
+/**
+ * Closure for #find_section_cb().
+ */
+struct FindSectionContext
+{
+  /**
+   * Name we are looking for.
+   */
+  const char *name;
+
+  /**
+   * Set to the section with that name, if found.
+   */
+  struct ConfigSection *result;
+};
+
+
+/**
+ * Check if a section with a matching hash has the name we look for.
+ *
+ * @param cls the `struct FindSectionContext`
+ * @param key hash of the section name
+ * @param value a `struct ConfigSection`
+ * @return #GNUNET_NO if we found the section, #GNUNET_YES to continue
+ */
+static int
+find_section_cb (void *cls,
+                 uint32_t key,
+                 void *value)
+{
+  struct FindSectionContext *fsc = cls;
+  struct ConfigSection *sec = value;
+
+  if (0 != strcasecmp (fsc->name, sec->name))
+    return GNUNET_YES;
+  fsc->result = sec;
+  return GNUNET_NO;
+}
+
+
+/**
+ * Find a section entry from a configuration.
+ *
+ * @param cfg configuration to search in
+ * @param section name of the section to look for
+ * @return matching entry, NULL if not found
+ */
+static struct ConfigSection *
+find_section (const struct GNUNET_CONFIGURATION_Handle *cfg,
+             const char *section)
+{
+  struct FindSectionContext fsc;
+
+  fsc.name = section;
+  fsc.result = NULL;
+  GNUNET_CONTAINER_multihashmap32_get_multiple (cfg->section_map,
+                                                name_hash (section),
+                                                &find_section_cb,
+                                                &fsc);
+  return fsc.result;
+}
+
+
+/**
+ * Find an entry from a configuration.
+ *
+ * @param cfg handle to the configuration
+ * @param section section the option is in
+ * @param key the option
+ * @return matching entry, NULL if not found
+ */
+static struct ConfigEntry *
+find_entry (const struct GNUNET_CONFIGURATION_Handle *cfg,
+           const char *section,
+           const char *key)
+{
+  struct ConfigSection *sec;
+  struct ConfigEntry *pos;
+  uint32_t hash;
+
+  if (NULL == (sec = find_section (cfg, section)))
+    return NULL;
+  hash = name_hash (key);
+  pos = sec->entries;
+  while ( (pos != NULL) &&
+          ( (hash != pos->hash) ||
+            (0 != strcasecmp (key, pos->key)) ) )
+    pos = pos->next;
+  return pos;
+}
+
+
 /**
  * Create a GNUNET_CONFIGURATION_Handle.
  *
@@ -119,7 +249,11 @@ struct DiffHandle
 struct GNUNET_CONFIGURATION_Handle *
 GNUNET_CONFIGURATION_create ()
 {
-  return GNUNET_new (struct GNUNET_CONFIGURATION_Handle);
+  struct GNUNET_CONFIGURATION_Handle *cfg;
+
+  cfg = GNUNET_new (struct GNUNET_CONFIGURATION_Handle);
+  cfg->section_map = GNUNET_CONTAINER_multihashmap32_create (16);
+  return cfg;
 }
 
 
@@ -135,6 +269,7 @@ GNUNET_CONFIGURATION_destroy (struct GNUNET_CONFIGURATION_Handle *cfg)
 
   while (NULL != (sec = cfg->sections))
     GNUNET_CONFIGURATION_remove_section (cfg, sec->name);
+  GNUNET_CONTAINER_multihashmap32_destroy (cfg->section_map);
   GNUNET_free (cfg);
 }
 
@@ -556,10 +691,7 @@ GNUNET_CONFIGURATION_iterate_section_values (const struct
   struct ConfigSection *spos;
   struct ConfigEntry *epos;
 
-  spos = cfg->sections;
-  while ((spos != NULL) && (0 != strcasecmp (spos->name, section)))
-    spos = spos->next;
-  if (NULL == spos)
+  if (NULL == (spos = find_section (cfg, section)))
     return;
   for (epos = spos->entries; NULL != epos; epos = epos->next)
     if (NULL != epos->val)
@@ -606,31 +738,32 @@ GNUNET_CONFIGURATION_remove_section (struct GNUNET_CONFIGURATION_Handle *cfg,
   struct ConfigSection *prev;
   struct ConfigEntry *ent;
 
-  prev = NULL;
-  spos = cfg->sections;
-  while (NULL != spos)
+  if (NULL == (spos = find_section (cfg, section)))
+    return;
+  if (cfg->sections == spos)
   {
-    if (0 == strcasecmp (section, spos->name))
-    {
-      if (NULL == prev)
-        cfg->sections = spos->next;
-      else
-        prev->next = spos->next;
-      while (NULL != (ent = spos->entries))
-      {
-        spos->entries = ent->next;
-        GNUNET_free (ent->key);
-        GNUNET_free_non_null (ent->val);
-        GNUNET_free (ent);
-        cfg->dirty = GNUNET_YES;
-      }
-      GNUNET_free (spos->name);
-      GNUNET_free (spos);
-      return;
-    }
-    prev = spos;
-    spos = spos->next;
+    cfg->sections = spos->next;
+  }
+  else
+  {
+    for (prev = cfg->sections; spos != prev->next; prev = prev->next)
+      ;
+    prev->next = spos->next;
+  }
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap32_remove (cfg->section_map,
+                                                         spos->hash,
+                                                         spos));
+  while (NULL != (ent = spos->entries))
+  {
+    spos->entries = ent->next;
+    GNUNET_free (ent->key);
+    GNUNET_free_non_null (ent->val);
+    GNUNET_free (ent);
+    cfg->dirty = GNUNET_YES;
   }
+  GNUNET_free (spos->name);
+  GNUNET_free (spos);
 }
 
 
@@ -672,51 +805,6 @@ GNUNET_CONFIGURATION_dup (const struct GNUNET_CONFIGURATION_Handle *cfg)
 }
 
 
-/**
- * Find a section entry from a configuration.
- *
- * @param cfg configuration to search in
- * @param section name of the section to look for
- * @return matching entry, NULL if not found
- */
-static struct ConfigSection *
-find_section (const struct GNUNET_CONFIGURATION_Handle *cfg,
-             const char *section)
-{
-  struct ConfigSection *pos;
-
-  pos = cfg->sections;
-  while ((pos != NULL) && (0 != strcasecmp (section, pos->name)))
-    pos = pos->next;
-  return pos;
-}
-
-
-/**
- * Find an entry from a configuration.
- *
- * @param cfg handle to the configuration
- * @param section section the option is in
- * @param key the option
- * @return matching entry, NULL if not found
- */
-static struct ConfigEntry *
-find_entry (const struct GNUNET_CONFIGURATION_Handle *cfg,
-           const char *section,
-           const char *key)
-{
-  struct ConfigSection *sec;
-  struct ConfigEntry *pos;
-
-  if (NULL == (sec = find_section (cfg, section)))
-    return NULL;
-  pos = sec->entries;
-  while ((pos != NULL) && (0 != strcasecmp (key, pos->key)))
-    pos = pos->next;
-  return pos;
-}
-
-
 /**
  * A callback function, compares entries from two configurations
  * (default against a new configuration) and write the diffs in a
@@ -827,11 +915,17 @@ GNUNET_CONFIGURATION_set_value_string (struct GNUNET_CONFIGURATION_Handle *cfg,
   {
     sec = GNUNET_new (struct ConfigSection);
     sec->name = GNUNET_strdup (section);
+    sec->hash = name_hash (section);
     sec->next = cfg->sections;
     cfg->sections = sec;
+    GNUNET_CONTAINER_multihashmap32_put (cfg->section_map,
+                                         sec->hash,
+                                         sec,
+                                         GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE);
   }
   e = GNUNET_new (struct ConfigEntry);
   e->key = GNUNET_strdup (option);
+  e->hash = name_hash (option);
   e->val = GNUNET_strdup (value);
   e->next = sec->entries;
   sec->entries = e;
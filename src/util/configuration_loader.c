@@ -31,27 +31,159 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
 /**
- * Load configuration (starts with defaults, then loads
- * system-specific configuration).
+ * Magic number at the start of a configuration snapshot ("GNCF").
+ */
+#define SNAPSHOT_MAGIC 0x474e4346
+
+/**
+ * Version of the snapshot format.
+ */
+#define SNAPSHOT_VERSION 1
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a configuration snapshot.  Followed by the 0-terminated
+ * expanded name of the configuration file and then by @e num_entries
+ * `struct SnapshotEntry`.
+ */
+struct SnapshotHeader
+{
+  /**
+   * #SNAPSHOT_MAGIC, in NBO.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * #SNAPSHOT_VERSION, in NBO.
+   */
+  uint32_t version GNUNET_PACKED;
+
+  /**
+   * Modification time of the configuration file, in NBO.
+   */
+  uint64_t cfg_mtime GNUNET_PACKED;
+
+  /**
+   * Size of the configuration file, in NBO.
+   */
+  uint64_t cfg_size GNUNET_PACKED;
+
+  /**
+   * Modification time of the defaults directory, in NBO.
+   */
+  uint64_t defaults_mtime GNUNET_PACKED;
+
+  /**
+   * Length of the file name including the terminator, in NBO.
+   */
+  uint32_t filename_len GNUNET_PACKED;
+
+  /**
+   * Number of entries, in NBO.
+   */
+  uint32_t num_entries GNUNET_PACKED;
+};
+
+
+/**
+ * One option in a configuration snapshot.  Followed by the
+ * 0-terminated section, option and value.
+ */
+struct SnapshotEntry
+{
+  /**
+   * Length of the section name including the terminator, in NBO.
+   */
+  uint32_t section_len GNUNET_PACKED;
+
+  /**
+   * Length of the option name including the terminator, in NBO.
+   */
+  uint32_t option_len GNUNET_PACKED;
+
+  /**
+   * Length of the value including the terminator, in NBO.
+   */
+  uint32_t value_len GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
+/**
+ * Options collected for writing a snapshot.
+ */
+struct SnapshotBuilder
+{
+  /**
+   * Serialized entries.
+   */
+  char *buf;
+
+  /**
+   * Bytes used in @e buf.
+   */
+  size_t off;
+
+  /**
+   * Allocated size of @e buf.
+   */
+  size_t size;
+
+  /**
+   * Start offset of each entry in @e buf.
+   */
+  size_t *starts;
+
+  /**
+   * Number of entries in @e starts.
+   */
+  unsigned int num_entries;
+
+  /**
+   * Allocated length of @e starts.
+   */
+  unsigned int starts_size;
+};
+
+
+/**
+ * Get the name of the directory with the default configuration.
  *
- * @param cfg configuration to update
- * @param filename name of the configuration file, NULL to load defaults
- * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ * @return directory name, NULL on error
  */
-int
-GNUNET_CONFIGURATION_load (struct GNUNET_CONFIGURATION_Handle *cfg,
-                           const char *filename)
+static char *
+get_defaults_dir ()
 {
   char *baseconfig;
   char *ipath;
 
   ipath = GNUNET_OS_installation_get_path (GNUNET_OS_IPK_DATADIR);
   if (NULL == ipath)
-    return GNUNET_SYSERR;
-  baseconfig = NULL;
+    return NULL;
   GNUNET_asprintf (&baseconfig, "%s%s", ipath, "config.d");
   GNUNET_free (ipath);
+  return baseconfig;
+}
+
+
+/**
+ * Parse the defaults and then @a filename.
+ *
+ * @param cfg configuration to update
+ * @param filename name of the configuration file, NULL to load defaults
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+static int
+load_files (struct GNUNET_CONFIGURATION_Handle *cfg,
+            const char *filename)
+{
+  char *baseconfig;
 
+  if (NULL == (baseconfig = get_defaults_dir ()))
+    return GNUNET_SYSERR;
   if (GNUNET_SYSERR ==
       GNUNET_CONFIGURATION_load_from (cfg,
                                       baseconfig))
@@ -74,4 +206,331 @@ GNUNET_CONFIGURATION_load (struct GNUNET_CONFIGURATION_Handle *cfg,
   return GNUNET_OK;
 }
 
+
+/**
+ * Fill in the fields of @a hdr that tell if a snapshot is still
+ * up to date.
+ *
+ * @param fn expanded name of the configuration file
+ * @param hdr header to update
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if a file is missing
+ */
+static int
+get_stamp (const char *fn,
+           struct SnapshotHeader *hdr)
+{
+  struct stat sbuf;
+  char *baseconfig;
+
+  if (0 != STAT (fn, &sbuf))
+    return GNUNET_SYSERR;
+  hdr->cfg_mtime = GNUNET_htonll ((uint64_t) sbuf.st_mtime);
+  hdr->cfg_size = GNUNET_htonll ((uint64_t) sbuf.st_size);
+  if (NULL == (baseconfig = get_defaults_dir ()))
+    return GNUNET_SYSERR;
+  if (0 != STAT (baseconfig, &sbuf))
+  {
+    GNUNET_free (baseconfig);
+    return GNUNET_SYSERR;
+  }
+  GNUNET_free (baseconfig);
+  hdr->defaults_mtime = GNUNET_htonll ((uint64_t) sbuf.st_mtime);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Append an option to the snapshot.
+ *
+ * @param cls the `struct SnapshotBuilder`
+ * @param section section of the option
+ * @param option name of the option
+ * @param value value of the option
+ */
+static void
+add_snapshot_entry (void *cls,
+                    const char *section,
+                    const char *option,
+                    const char *value)
+{
+  struct SnapshotBuilder *sb = cls;
+  struct SnapshotEntry se;
+  size_t slen = strlen (section) + 1;
+  size_t olen = strlen (option) + 1;
+  size_t vlen = strlen (value) + 1;
+  size_t need = sizeof (se) + slen + olen + vlen;
+
+  if (sb->off + need > sb->size)
+  {
+    sb->size = GNUNET_MAX (2 * sb->size, sb->off + need);
+    sb->buf = GNUNET_realloc (sb->buf, sb->size);
+  }
+  if (sb->num_entries == sb->starts_size)
+    GNUNET_array_grow (sb->starts,
+                       sb->starts_size,
+                       2 * sb->starts_size + 16);
+  sb->starts[sb->num_entries++] = sb->off;
+  se.section_len = htonl ((uint32_t) slen);
+  se.option_len = htonl ((uint32_t) olen);
+  se.value_len = htonl ((uint32_t) vlen);
+  memcpy (&sb->buf[sb->off], &se, sizeof (se));
+  sb->off += sizeof (se);
+  memcpy (&sb->buf[sb->off], section, slen);
+  sb->off += slen;
+  memcpy (&sb->buf[sb->off], option, olen);
+  sb->off += olen;
+  memcpy (&sb->buf[sb->off], value, vlen);
+  sb->off += vlen;
+}
+
+
+/**
+ * Load the configuration like #GNUNET_CONFIGURATION_load() would and
+ * store the result in a pre-parsed binary snapshot.  If the
+ * environment variable #GNUNET_CONFIGURATION_SNAPSHOT_ENV names the
+ * snapshot, #GNUNET_CONFIGURATION_load() uses it instead of parsing
+ * the configuration files again, as long as @a filename and the
+ * defaults directory did not change since the snapshot was written.
+ *
+ * @param snapshot name of the snapshot file to write
+ * @param filename name of the configuration file
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CONFIGURATION_snapshot_write (const char *snapshot,
+                                     const char *filename)
+{
+  struct GNUNET_CONFIGURATION_Handle *cfg;
+  struct SnapshotHeader hdr;
+  struct SnapshotBuilder sb;
+  char *fn;
+  char *out;
+  size_t flen;
+  size_t total;
+  size_t pos;
+  size_t len;
+  unsigned int i;
+  int ret;
+
+  if (NULL == (fn = GNUNET_STRINGS_filename_expand (filename)))
+    return GNUNET_SYSERR;
+  memset (&hdr, 0, sizeof (hdr));
+  /* take the stamp before parsing, so that changes made while we
+     parse invalidate the snapshot */
+  if (GNUNET_OK != get_stamp (fn, &hdr))
+  {
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  cfg = GNUNET_CONFIGURATION_create ();
+  if (GNUNET_OK != load_files (cfg, filename))
+  {
+    GNUNET_CONFIGURATION_destroy (cfg);
+    GNUNET_free (fn);
+    return GNUNET_SYSERR;
+  }
+  memset (&sb, 0, sizeof (sb));
+  GNUNET_CONFIGURATION_iterate (cfg, &add_snapshot_entry, &sb);
+  GNUNET_CONFIGURATION_destroy (cfg);
+  flen = strlen (fn) + 1;
+  hdr.magic = htonl (SNAPSHOT_MAGIC);
+  hdr.version = htonl (SNAPSHOT_VERSION);
+  hdr.filename_len = htonl ((uint32_t) flen);
+  hdr.num_entries = htonl (sb.num_entries);
+  total = sizeof (hdr) + flen + sb.off;
+  out = GNUNET_malloc (total);
+  memcpy (out, &hdr, sizeof (hdr));
+  memcpy (&out[sizeof (hdr)], fn, flen);
+  GNUNET_free (fn);
+  /* loading prepends options and sections, so store them in
+     reverse to get the original order back */
+  pos = sizeof (hdr) + flen;
+  for (i = sb.num_entries; i > 0; i--)
+  {
+    len = ((i == sb.num_entries) ? sb.off : sb.starts[i]) - sb.starts[i - 1];
+    memcpy (&out[pos], &sb.buf[sb.starts[i - 1]], len);
+    pos += len;
+  }
+  GNUNET_assert (pos == total);
+  GNUNET_free_non_null (sb.buf);
+  GNUNET_array_grow (sb.starts, sb.starts_size, 0);
+  ret = (total == GNUNET_DISK_fn_write (snapshot, out, total,
+                                        GNUNET_DISK_PERM_USER_READ |
+                                        GNUNET_DISK_PERM_USER_WRITE))
+    ? GNUNET_OK : GNUNET_SYSERR;
+  GNUNET_free (out);
+  return ret;
+}
+
+
+/**
+ * Check that a mapped snapshot is well-formed and matches the
+ * current state of the configuration files.
+ *
+ * @param data snapshot contents
+ * @param size number of bytes in @a data
+ * @param fn expanded name of the configuration file to load
+ * @return offset of the first entry, 0 if the snapshot cannot be used
+ */
+static size_t
+check_snapshot (const char *data,
+                size_t size,
+                const char *fn)
+{
+  struct SnapshotHeader hdr;
+  struct SnapshotHeader now;
+  struct SnapshotEntry se;
+  size_t pos;
+  size_t len[3];
+  uint32_t flen;
+  uint32_t n;
+  unsigned int i;
+
+  if (size < sizeof (hdr))
+    return 0;
+  memcpy (&hdr, data, sizeof (hdr));
+  flen = ntohl (hdr.filename_len);
+  if ( (SNAPSHOT_MAGIC != ntohl (hdr.magic)) ||
+       (SNAPSHOT_VERSION != ntohl (hdr.version)) ||
+       (flen != strlen (fn) + 1) ||
+       (size - sizeof (hdr) < flen) ||
+       (0 != memcmp (&data[sizeof (hdr)], fn, flen)) )
+    return 0;
+  if ( (GNUNET_OK != get_stamp (fn, &now)) ||
+       (now.cfg_mtime != hdr.cfg_mtime) ||
+       (now.cfg_size != hdr.cfg_size) ||
+       (now.defaults_mtime != hdr.defaults_mtime) )
+    return 0;
+  pos = sizeof (hdr) + flen;
+  n = ntohl (hdr.num_entries);
+  while (n-- > 0)
+  {
+    if (size - pos < sizeof (se))
+      return 0;
+    memcpy (&se, &data[pos], sizeof (se));
+    pos += sizeof (se);
+    len[0] = ntohl (se.section_len);
+    len[1] = ntohl (se.option_len);
+    len[2] = ntohl (se.value_len);
+    for (i = 0; i < 3; i++)
+    {
+      if ( (0 == len[i]) ||
+           (size - pos < len[i]) ||
+           ('\0' != data[pos + len[i] - 1]) )
+        return 0;
+      pos += len[i];
+    }
+  }
+  if (pos != size)
+    return 0;
+  return sizeof (hdr) + flen;
+}
+
+
+/**
+ * Try to load the configuration from the snapshot named in the
+ * environment.
+ *
+ * @param cfg configuration to update
+ * @param snapshot name of the snapshot file
+ * @param filename name of the configuration file
+ * @return #GNUNET_OK on success, #GNUNET_NO if the snapshot cannot be used
+ */
+static int
+load_snapshot (struct GNUNET_CONFIGURATION_Handle *cfg,
+               const char *snapshot,
+               const char *filename)
+{
+  struct GNUNET_DISK_FileHandle *fh;
+  struct GNUNET_DISK_MapHandle *mh;
+  struct SnapshotEntry se;
+  const char *data;
+  const char *section;
+  const char *option;
+  char *fn;
+  off_t fsize;
+  size_t pos;
+  uint32_t n;
+
+  if (NULL == (fn = GNUNET_STRINGS_filename_expand (filename)))
+    return GNUNET_NO;
+  fh = GNUNET_DISK_file_open (snapshot,
+                              GNUNET_DISK_OPEN_READ,
+                              GNUNET_DISK_PERM_NONE);
+  if (NULL == fh)
+  {
+    GNUNET_free (fn);
+    return GNUNET_NO;
+  }
+  data = NULL;
+  if ( (GNUNET_OK == GNUNET_DISK_file_handle_size (fh, &fsize)) &&
+       (fsize > 0) &&
+       (fsize == (off_t) (size_t) fsize) )
+    data = GNUNET_DISK_file_map (fh, &mh,
+                                 GNUNET_DISK_MAP_TYPE_READ,
+                                 (size_t) fsize);
+  if (NULL == data)
+  {
+    GNUNET_DISK_file_close (fh);
+    GNUNET_free (fn);
+    return GNUNET_NO;
+  }
+  pos = check_snapshot (data, (size_t) fsize, fn);
+  GNUNET_free (fn);
+  if (0 == pos)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Configuration snapshot `%s' is stale, parsing `%s'\n",
+         snapshot,
+         filename);
+    GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (mh));
+    GNUNET_DISK_file_close (fh);
+    return GNUNET_NO;
+  }
+  n = 0;
+  while (pos < (size_t) fsize)
+  {
+    memcpy (&se, &data[pos], sizeof (se));
+    pos += sizeof (se);
+    section = &data[pos];
+    pos += ntohl (se.section_len);
+    option = &data[pos];
+    pos += ntohl (se.option_len);
+    GNUNET_CONFIGURATION_set_value_string (cfg, section, option, &data[pos]);
+    pos += ntohl (se.value_len);
+    n++;
+  }
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_unmap (mh));
+  GNUNET_DISK_file_close (fh);
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Loaded %u options from configuration snapshot `%s'\n",
+       (unsigned int) n,
+       snapshot);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Load configuration (starts with defaults, then loads
+ * system-specific configuration).  Uses the snapshot named in
+ * #GNUNET_CONFIGURATION_SNAPSHOT_ENV if it is up to date.
+ *
+ * @param cfg configuration to update
+ * @param filename name of the configuration file, NULL to load defaults
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CONFIGURATION_load (struct GNUNET_CONFIGURATION_Handle *cfg,
+                           const char *filename)
+{
+  const char *snapshot;
+
+  snapshot = getenv (GNUNET_CONFIGURATION_SNAPSHOT_ENV);
+  if ( (NULL != snapshot) &&
+       (NULL != filename) &&
+       (GNUNET_OK == load_snapshot (cfg, snapshot, filename)) )
+    return GNUNET_OK;
+  return load_files (cfg, filename);
+}
+
 /* end of configuration_loader.c */
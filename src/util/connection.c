@@ -33,6 +33,7 @@
 #include "platform.h"
 #include "gnunet_util_lib.h"
 #include "gnunet_resolver_service.h"
+#include "shm_ring.h"
 
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
@@ -78,6 +79,39 @@ struct GNUNET_CONNECTION_TransmitHandle
    */
   size_t notify_size;
 
+  /**
+   * Function to call once @e msgs were transmitted, NULL unless
+   * this is a request from #GNUNET_CONNECTION_transmit_messages().
+   */
+  GNUNET_CONNECTION_TransmitContinuation cont;
+
+  /**
+   * Closure for @e cont.
+   */
+  void *cont_cls;
+
+  /**
+   * Messages to transmit without copying them.
+   */
+  const struct GNUNET_MessageHeader *msgs[GNUNET_CONNECTION_MAX_MESSAGES];
+
+  /**
+   * Number of entries in @e msgs.
+   */
+  unsigned int msg_count;
+
+  /**
+   * Index of the first message in @e msgs that was not yet
+   * transmitted completely.
+   */
+  unsigned int msg_pos;
+
+  /**
+   * Number of bytes of the message at @e msg_pos that were
+   * already transmitted.
+   */
+  size_t msg_off;
+
 };
 
 
@@ -125,6 +159,59 @@ struct AddressProbe
 };
 
 
+/**
+ * State of the shared memory fast path of a UNIX domain connection.
+ */
+enum ShmState
+{
+  /**
+   * Data goes through the socket.
+   */
+  SHM_STATE_NONE = 0,
+
+  /**
+   * Accepted connection of a service that supports shared memory;
+   * the first bytes from the client tell us if it offers a segment.
+   */
+  SHM_STATE_PROBE,
+
+  /**
+   * We offered a segment to the service and wait for the answer.
+   */
+  SHM_STATE_OFFERED,
+
+  /**
+   * Data goes through the segment, the socket only carries wakeups.
+   */
+  SHM_STATE_ACTIVE
+};
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Message used to negotiate shared memory on a UNIX domain
+ * connection.  The client sends it (with the file descriptor of the
+ * segment attached) as the very first message; the service answers
+ * with the same message before sending anything else.
+ */
+struct ShmMessage
+{
+  /**
+   * Type is #GNUNET_MESSAGE_TYPE_CONNECTION_SHM.
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * #GNUNET_NO in the offer; in the answer, #GNUNET_YES if the
+   * service attached to the segment, #GNUNET_NO if not.
+   */
+  uint32_t accepted GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
+
+
 /**
  * @brief handle for a network connection
  */
@@ -174,6 +261,12 @@ struct GNUNET_CONNECTION_Handle
    */
   void *receiver_cls;
 
+  /**
+   * Buffer to read into given to #GNUNET_CONNECTION_receive_into(),
+   * NULL to read into a buffer on the stack.
+   */
+  char *receive_buffer;
+
   /**
    * Pointer to our write buffer.
    */
@@ -256,6 +349,51 @@ struct GNUNET_CONNECTION_Handle
    */
   struct GNUNET_CONNECTION_Handle *proxy_handshake;
 
+  /**
+   * Shared memory segment we exchange data through, NULL if
+   * we use the socket.
+   */
+  struct GNUNET_SHM_Segment *shm;
+
+  /**
+   * Task reading the socket while we negotiate shared memory, or
+   * waiting for wakeups once the segment is in use.
+   */
+  struct GNUNET_SCHEDULER_Task *shm_task;
+
+  /**
+   * Bytes read from the socket while negotiating.  If they turn
+   * out to be ordinary data, they are given to the next receiver
+   * before anything else.
+   */
+  char shm_buf[sizeof (struct ShmMessage)];
+
+  /**
+   * Number of bytes in @e shm_buf.
+   */
+  size_t shm_buf_len;
+
+  /**
+   * State of the shared memory fast path.
+   */
+  enum ShmState shm_state;
+
+  /**
+   * Ring we read from if @e shm_state is #SHM_STATE_ACTIVE.
+   */
+  enum GNUNET_SHM_Direction shm_rx;
+
+  /**
+   * Ring we write to if @e shm_state is #SHM_STATE_ACTIVE.
+   */
+  enum GNUNET_SHM_Direction shm_tx;
+
+  /**
+   * #GNUNET_YES once the other side closed the socket while we used
+   * shared memory; data left in the ring is still delivered.
+   */
+  int shm_eof;
+
 };
 
 
@@ -291,6 +429,27 @@ GNUNET_CONNECTION_disable_corking (struct GNUNET_CONNECTION_Handle *connection)
 }
 
 
+/**
+ * Limit the amount of data that the kernel buffers for the given
+ * connection beyond what it could already send, so that queued data
+ * stays with the application as long as possible.
+ *
+ * @param connection the connection to configure
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if this is not
+ *         supported (or the connection has no socket yet)
+ */
+int
+GNUNET_CONNECTION_set_notsent_lowat (struct GNUNET_CONNECTION_Handle *connection,
+                                     uint32_t bytes)
+{
+  if (NULL == connection->sock)
+    return GNUNET_SYSERR;
+  return GNUNET_NETWORK_socket_set_notsent_lowat (connection->sock,
+                                                  bytes);
+}
+
+
 /**
  * Create a connection handle by boxing an existing OS socket.  The OS
  * socket should henceforth be no longer used directly.
@@ -623,6 +782,27 @@ static void
 receive_ready (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
 
 
+/**
+ * Deliver data from the shared memory ring (or bytes left over
+ * from negotiating shared memory) to the receiver.
+ *
+ * @param cls connection to read from
+ * @param tc scheduler context
+ */
+static void
+shm_receive_ready (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
+/**
+ * Move pending data into the shared memory ring.
+ *
+ * @param cls connection to write to
+ * @param tc scheduler context
+ */
+static void
+shm_transmit_ready (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc);
+
+
 /**
  * We've succeeded in establishing a connection.
  *
@@ -996,7 +1176,8 @@ GNUNET_CONNECTION_check (struct GNUNET_CONNECTION_Handle *connection)
       (NULL != connection->proxy_handshake))
     return GNUNET_YES;          /* still trying to connect */
   if ( (0 != connection->destroy_later) ||
-       (NULL == connection->sock) )
+       (NULL == connection->sock) ||
+       (GNUNET_YES == connection->shm_eof) )
     return GNUNET_NO;
   return GNUNET_YES;
 }
@@ -1041,6 +1222,16 @@ GNUNET_CONNECTION_destroy (struct GNUNET_CONNECTION_Handle *connection)
     connection->nth.timeout_task = NULL;
   }
   connection->nth.notify_ready = NULL;
+  if (NULL != connection->shm_task)
+  {
+    GNUNET_SCHEDULER_cancel (connection->shm_task);
+    connection->shm_task = NULL;
+  }
+  if (NULL != connection->shm)
+  {
+    GNUNET_SHM_segment_destroy_ (connection->shm);
+    connection->shm = NULL;
+  }
   if (NULL != connection->dns_active)
   {
     GNUNET_RESOLVER_request_cancel (connection->dns_active);
@@ -1102,11 +1293,15 @@ receive_ready (void *cls,
                const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct GNUNET_CONNECTION_Handle *connection = cls;
-  char buffer[connection->max];
+  char sbuffer[(NULL == connection->receive_buffer) ? connection->max : 1];
+  char *buffer;
   ssize_t ret;
   GNUNET_CONNECTION_Receiver receiver;
 
   connection->read_task = NULL;
+  buffer = (NULL == connection->receive_buffer)
+    ? sbuffer
+    : connection->receive_buffer;
   if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_SHUTDOWN))
   {
     /* ignore shutdown request, go again immediately */
@@ -1163,40 +1358,73 @@ RETRY:
 
 
 /**
- * Receive data from the given connection.  Note that this function will
- * call @a receiver asynchronously using the scheduler.  It will
- * "immediately" return.  Note that there MUST only be one active
- * receive call per connection at any given point in time (so do not
- * call receive again until the receiver callback has been invoked).
+ * Schedule the task that will serve the pending receive request of
+ * a connected @a connection.
+ *
+ * @param connection connection with a pending receiver
+ */
+static void
+schedule_receive (struct GNUNET_CONNECTION_Handle *connection)
+{
+  struct GNUNET_TIME_Relative timeout;
+
+  timeout = GNUNET_TIME_absolute_get_remaining (connection->receive_timeout);
+  if ( (SHM_STATE_PROBE == connection->shm_state) ||
+       (SHM_STATE_OFFERED == connection->shm_state) )
+  {
+    /* wait for the negotiation to finish, see shm_finish() */
+    connection->read_task =
+      GNUNET_SCHEDULER_add_delayed (timeout,
+                                    &shm_receive_ready,
+                                    connection);
+    return;
+  }
+  if ( (SHM_STATE_ACTIVE == connection->shm_state) ||
+       (0 < connection->shm_buf_len) )
+  {
+    connection->read_task =
+      GNUNET_SCHEDULER_add_now (&shm_receive_ready,
+                                connection);
+    return;
+  }
+  connection->read_task =
+    GNUNET_SCHEDULER_add_read_net (timeout,
+                                   connection->sock,
+                                   &receive_ready,
+                                   connection);
+}
+
+
+/**
+ * Start receiving data from the given connection.
  *
  * @param connection connection handle
+ * @param buf where to store the received data, NULL to use a
+ *        buffer on the stack
  * @param max maximum number of bytes to read
  * @param timeout maximum amount of time to wait
  * @param receiver function to call with received data
  * @param receiver_cls closure for @a receiver
  */
-void
-GNUNET_CONNECTION_receive (struct GNUNET_CONNECTION_Handle *connection,
-                           size_t max,
-                           struct GNUNET_TIME_Relative timeout,
-                           GNUNET_CONNECTION_Receiver receiver,
-                           void *receiver_cls)
+static void
+start_receive (struct GNUNET_CONNECTION_Handle *connection,
+               char *buf,
+               size_t max,
+               struct GNUNET_TIME_Relative timeout,
+               GNUNET_CONNECTION_Receiver receiver,
+               void *receiver_cls)
 {
   GNUNET_assert ((NULL == connection->read_task) &&
                  (NULL == connection->receiver));
   GNUNET_assert (NULL != receiver);
+  connection->receive_buffer = buf;
   connection->receiver = receiver;
   connection->receiver_cls = receiver_cls;
   connection->receive_timeout = GNUNET_TIME_relative_to_absolute (timeout);
   connection->max = max;
   if (NULL != connection->sock)
   {
-    connection->read_task =
-      GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_absolute_get_remaining
-                                     (connection->receive_timeout),
-                                     connection->sock,
-                                     &receive_ready,
-                                     connection);
+    schedule_receive (connection);
     return;
   }
   if ((NULL == connection->dns_active) &&
@@ -1210,6 +1438,67 @@ GNUNET_CONNECTION_receive (struct GNUNET_CONNECTION_Handle *connection,
 }
 
 
+/**
+ * Receive data from the given connection.  Note that this function will
+ * call @a receiver asynchronously using the scheduler.  It will
+ * "immediately" return.  Note that there MUST only be one active
+ * receive call per connection at any given point in time (so do not
+ * call receive again until the receiver callback has been invoked).
+ *
+ * @param connection connection handle
+ * @param max maximum number of bytes to read
+ * @param timeout maximum amount of time to wait
+ * @param receiver function to call with received data
+ * @param receiver_cls closure for @a receiver
+ */
+void
+GNUNET_CONNECTION_receive (struct GNUNET_CONNECTION_Handle *connection,
+                           size_t max,
+                           struct GNUNET_TIME_Relative timeout,
+                           GNUNET_CONNECTION_Receiver receiver,
+                           void *receiver_cls)
+{
+  start_receive (connection,
+                 NULL,
+                 max,
+                 timeout,
+                 receiver,
+                 receiver_cls);
+}
+
+
+/**
+ * Receive data from the given connection into a buffer provided by
+ * the caller.  Like #GNUNET_CONNECTION_receive(), except that the
+ * data is read directly into @a buf, which is also what is passed
+ * to @a receiver.  @a buf must remain valid until @a receiver was
+ * called or the receive was cancelled.
+ *
+ * @param connection connection handle
+ * @param buf where to store the received data
+ * @param max maximum number of bytes to read, size of @a buf
+ * @param timeout maximum amount of time to wait
+ * @param receiver function to call with received data
+ * @param receiver_cls closure for @a receiver
+ */
+void
+GNUNET_CONNECTION_receive_into (struct GNUNET_CONNECTION_Handle *connection,
+                                void *buf,
+                                size_t max,
+                                struct GNUNET_TIME_Relative timeout,
+                                GNUNET_CONNECTION_Receiver receiver,
+                                void *receiver_cls)
+{
+  GNUNET_assert (NULL != buf);
+  start_receive (connection,
+                 buf,
+                 max,
+                 timeout,
+                 receiver,
+                 receiver_cls);
+}
+
+
 /**
  * Cancel receive job on the given connection.  Note that the
  * receiver callback must not have been called yet in order
@@ -1349,6 +1638,132 @@ connect_error (void *cls,
 }
 
 
+/**
+ * Notification for requests from #GNUNET_CONNECTION_transmit_messages().
+ * Only called if the transmission failed (timeout, shutdown or error),
+ * transmit_messages_ready() handles the transmission itself.
+ *
+ * @param cls the `struct GNUNET_CONNECTION_Handle`
+ * @param size 0
+ * @param buf NULL
+ * @return 0
+ */
+static size_t
+transmit_messages_failed (void *cls,
+                          size_t size,
+                          void *buf)
+{
+  struct GNUNET_CONNECTION_Handle *connection = cls;
+  GNUNET_CONNECTION_TransmitContinuation cont;
+
+  GNUNET_assert (NULL == buf);
+  cont = connection->nth.cont;
+  connection->nth.cont = NULL;
+  cont (connection->nth.cont_cls,
+        GNUNET_SYSERR);
+  return 0;
+}
+
+
+/**
+ * The socket is ready for writing and we have a request from
+ * #GNUNET_CONNECTION_transmit_messages().  Send any buffered data
+ * followed by the messages with a single system call.
+ *
+ * @param connection connection to transmit on
+ */
+static void
+transmit_messages_ready (struct GNUNET_CONNECTION_Handle *connection)
+{
+  struct GNUNET_CONNECTION_TransmitHandle *th = &connection->nth;
+  const void *bufs[GNUNET_CONNECTION_MAX_MESSAGES + 1];
+  size_t lens[GNUNET_CONNECTION_MAX_MESSAGES + 1];
+  GNUNET_CONNECTION_TransmitContinuation cont;
+  unsigned int n;
+  unsigned int i;
+  size_t have;
+  size_t done;
+  size_t len;
+  ssize_t ret;
+
+  n = 0;
+  have = connection->write_buffer_off - connection->write_buffer_pos;
+  if (0 < have)
+  {
+    bufs[n] = &connection->write_buffer[connection->write_buffer_pos];
+    lens[n++] = have;
+  }
+  for (i = th->msg_pos; i < th->msg_count; i++)
+  {
+    len = (i == th->msg_pos) ? th->msg_off : 0;
+    bufs[n] = &((const char *) th->msgs[i])[len];
+    lens[n++] = ntohs (th->msgs[i]->size) - len;
+  }
+RETRY:
+  ret = GNUNET_NETWORK_socket_sendv (connection->sock,
+                                     bufs,
+                                     lens,
+                                     n);
+  if (-1 == ret)
+  {
+    if (EINTR == errno)
+      goto RETRY;
+    signal_transmit_error (connection, errno);
+    return;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Connection transmitted %u bytes from %u buffers to `%s' (%p)\n",
+       (unsigned int) ret,
+       n,
+       GNUNET_a2s (connection->addr, connection->addrlen),
+       connection);
+  /* buffered data went out first */
+  done = GNUNET_MIN ((size_t) ret, have);
+  connection->write_buffer_pos += done;
+  if (connection->write_buffer_pos == connection->write_buffer_off)
+  {
+    connection->write_buffer_pos = 0;
+    connection->write_buffer_off = 0;
+  }
+  done = ret - done;
+  while ( (th->msg_pos < th->msg_count) &&
+          (0 < done) )
+  {
+    len = ntohs (th->msgs[th->msg_pos]->size) - th->msg_off;
+    if (done < len)
+    {
+      th->msg_off += done;
+      break;
+    }
+    done -= len;
+    th->msg_pos++;
+    th->msg_off = 0;
+  }
+  if (th->msg_pos == th->msg_count)
+  {
+    /* all messages were passed to the kernel */
+    cont = th->cont;
+    th->cont = NULL;
+    th->notify_ready = NULL;
+    cont (th->cont_cls,
+          GNUNET_OK);
+    return;
+  }
+  if ( (0 < th->msg_pos) ||
+       (0 < th->msg_off) )
+  {
+    /* we started transmitting, must not time out any more */
+    th->transmit_timeout = GNUNET_TIME_UNIT_FOREVER_ABS;
+  }
+  connection->write_task =
+    GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_absolute_get_remaining
+                                    (th->transmit_timeout),
+                                    connection->sock,
+                                    &transmit_ready,
+                                    connection);
+}
+
+
 /**
  * We are ready to transmit (or got a timeout).
  *
@@ -1414,6 +1829,11 @@ transmit_ready (void *cls,
     goto SCHEDULE_WRITE;
   }
   GNUNET_assert (connection->write_buffer_off >= connection->write_buffer_pos);
+  if (NULL != connection->nth.cont)
+  {
+    transmit_messages_ready (connection);
+    return;
+  }
   if ((NULL != connection->nth.notify_ready) &&
       (connection->write_buffer_size < connection->nth.notify_size))
   {
@@ -1476,6 +1896,533 @@ SCHEDULE_WRITE:
 }
 
 
+/**
+ * Tell the other side to look at the rings again.
+ *
+ * @param connection connection using shared memory
+ */
+static void
+shm_wake_peer (struct GNUNET_CONNECTION_Handle *connection)
+{
+  char wakeup;
+
+  if (GNUNET_YES == connection->shm_eof)
+    return;
+  wakeup = 0;
+  /* if the socket buffer is full, the other side has
+     unread wakeups anyway */
+  (void) GNUNET_NETWORK_socket_send (connection->sock,
+                                     &wakeup,
+                                     sizeof (wakeup));
+}
+
+
+/**
+ * The other side corrupted the shared memory segment; stop using
+ * the connection.
+ *
+ * @param connection connection using shared memory
+ */
+static void
+shm_corrupt (struct GNUNET_CONNECTION_Handle *connection)
+{
+  GNUNET_break_op (0);
+  LOG (GNUNET_ERROR_TYPE_WARNING,
+       _("Shared memory of connection to `%s' is corrupt, closing it\n"),
+       GNUNET_a2s (connection->addr, connection->addrlen));
+  connection->shm_eof = GNUNET_YES;
+  (void) GNUNET_NETWORK_socket_shutdown (connection->sock,
+                                         SHUT_RDWR);
+}
+
+
+/**
+ * Deliver data from the shared memory ring (or bytes left over
+ * from negotiating shared memory) to the receiver.
+ *
+ * @param cls connection to read from
+ * @param tc scheduler context
+ */
+static void
+shm_receive_ready (void *cls,
+                   const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CONNECTION_Handle *connection = cls;
+  char sbuffer[(NULL == connection->receive_buffer) ? connection->max : 1];
+  struct GNUNET_TIME_Relative timeout;
+  GNUNET_CONNECTION_Receiver receiver;
+  char *buffer;
+  ssize_t ret;
+
+  connection->read_task = NULL;
+  buffer = (NULL == connection->receive_buffer)
+    ? sbuffer
+    : connection->receive_buffer;
+  timeout = GNUNET_TIME_absolute_get_remaining (connection->receive_timeout);
+  if ( (SHM_STATE_PROBE == connection->shm_state) ||
+       (SHM_STATE_OFFERED == connection->shm_state) )
+  {
+    /* timed out (or shutdown) while negotiating */
+    if (0 == timeout.rel_value_us)
+    {
+      signal_receive_timeout (connection);
+      return;
+    }
+    schedule_receive (connection);
+    return;
+  }
+  if (0 < connection->shm_buf_len)
+  {
+    /* the client did not negotiate, these are ordinary data */
+    ret = GNUNET_MIN (connection->max, connection->shm_buf_len);
+    memcpy (buffer, connection->shm_buf, ret);
+    memmove (connection->shm_buf,
+             &connection->shm_buf[ret],
+             connection->shm_buf_len - ret);
+    connection->shm_buf_len -= ret;
+    goto DELIVER;
+  }
+  GNUNET_assert (SHM_STATE_ACTIVE == connection->shm_state);
+  ret = GNUNET_SHM_ring_read_ (connection->shm,
+                               connection->shm_rx,
+                               buffer,
+                               connection->max);
+  if (-1 == ret)
+  {
+    shm_corrupt (connection);
+    signal_receive_error (connection, ECONNRESET);
+    return;
+  }
+  if (0 < ret)
+  {
+    if (GNUNET_YES ==
+        GNUNET_SHM_ring_test_writer_ (connection->shm,
+                                      connection->shm_rx))
+      shm_wake_peer (connection);
+    goto DELIVER;
+  }
+  if (GNUNET_YES == connection->shm_eof)
+    goto DELIVER;               /* ret == 0 signals EOF, like recv() */
+  if (0 == timeout.rel_value_us)
+  {
+    signal_receive_timeout (connection);
+    return;
+  }
+  if (GNUNET_YES ==
+      GNUNET_SHM_ring_wait_read_ (connection->shm,
+                                  connection->shm_rx))
+  {
+    connection->read_task =
+      GNUNET_SCHEDULER_add_now (&shm_receive_ready,
+                                connection);
+    return;
+  }
+  /* wait for the writer to wake us up, see shm_wakeup() */
+  connection->read_task =
+    GNUNET_SCHEDULER_add_delayed (timeout,
+                                  &shm_receive_ready,
+                                  connection);
+  return;
+ DELIVER:
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "shm_receive_ready read %u/%u bytes from `%s' (%p)!\n",
+       (unsigned int) ret,
+       connection->max,
+       GNUNET_a2s (connection->addr,
+                   connection->addrlen),
+       connection);
+  GNUNET_assert (NULL != (receiver = connection->receiver));
+  connection->receiver = NULL;
+  receiver (connection->receiver_cls,
+            buffer,
+            ret,
+            connection->addr,
+            connection->addrlen,
+            0);
+}
+
+
+/**
+ * Move pending data into the shared memory ring: first what is
+ * left in the write buffer, then the messages of a
+ * #GNUNET_CONNECTION_transmit_messages() request or whatever the
+ * notify callback gives us.
+ *
+ * @param cls connection to write to
+ * @param tc scheduler context
+ */
+static void
+shm_transmit_ready (void *cls,
+                    const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CONNECTION_Handle *connection = cls;
+  struct GNUNET_CONNECTION_TransmitHandle *th = &connection->nth;
+  GNUNET_CONNECTION_TransmitReadyNotify notify;
+  GNUNET_CONNECTION_TransmitContinuation cont;
+  const char *msg;
+  ssize_t ret;
+  size_t have;
+  size_t len;
+  int wrote;
+
+  connection->write_task = NULL;
+  if ( (NULL != th->notify_ready) &&
+       (NULL == th->cont) &&
+       (connection->write_buffer_size < th->notify_size) )
+  {
+    connection->write_buffer =
+        GNUNET_realloc (connection->write_buffer, th->notify_size);
+    connection->write_buffer_size = th->notify_size;
+  }
+  if (GNUNET_YES == connection->shm_eof)
+    goto FAIL;
+  wrote = GNUNET_NO;
+  while (1)
+  {
+    have = connection->write_buffer_off - connection->write_buffer_pos;
+    if (0 < have)
+    {
+      ret = GNUNET_SHM_ring_write_ (connection->shm,
+                                    connection->shm_tx,
+                                    &connection->write_buffer[connection->write_buffer_pos],
+                                    have);
+      if (-1 == ret)
+        goto CORRUPT;
+      if (0 == ret)
+        break;
+      wrote = GNUNET_YES;
+      connection->write_buffer_pos += ret;
+      if (connection->write_buffer_pos == connection->write_buffer_off)
+      {
+        connection->write_buffer_pos = 0;
+        connection->write_buffer_off = 0;
+      }
+      continue;
+    }
+    if (NULL != th->cont)
+    {
+      if (th->msg_pos == th->msg_count)
+      {
+        /* all messages are in the ring */
+        if ( (GNUNET_YES == wrote) &&
+             (GNUNET_YES ==
+              GNUNET_SHM_ring_test_reader_ (connection->shm,
+                                            connection->shm_tx)) )
+          shm_wake_peer (connection);
+        cont = th->cont;
+        th->cont = NULL;
+        th->notify_ready = NULL;
+        cont (th->cont_cls,
+              GNUNET_OK);
+        return;
+      }
+      msg = (const char *) th->msgs[th->msg_pos];
+      len = ntohs (th->msgs[th->msg_pos]->size);
+      ret = GNUNET_SHM_ring_write_ (connection->shm,
+                                    connection->shm_tx,
+                                    &msg[th->msg_off],
+                                    len - th->msg_off);
+      if (-1 == ret)
+        goto CORRUPT;
+      if (0 == ret)
+        break;
+      wrote = GNUNET_YES;
+      /* we started transmitting, must not time out any more */
+      th->transmit_timeout = GNUNET_TIME_UNIT_FOREVER_ABS;
+      th->msg_off += ret;
+      if (th->msg_off == len)
+      {
+        th->msg_pos++;
+        th->msg_off = 0;
+      }
+      continue;
+    }
+    /* the notify callback may have asked for more already */
+    if ( (NULL != connection->write_task) ||
+         (GNUNET_YES != process_notify (connection)) )
+      break;
+  }
+  if ( (GNUNET_YES == wrote) &&
+       (GNUNET_YES ==
+        GNUNET_SHM_ring_test_reader_ (connection->shm,
+                                      connection->shm_tx)) )
+    shm_wake_peer (connection);
+  if ( (0 == connection->write_buffer_off) &&
+       (NULL == th->notify_ready) )
+    return;                     /* all data is in the ring */
+  if (NULL != connection->write_task)
+    return;
+  if ( (NULL != th->notify_ready) &&
+       (0 == GNUNET_TIME_absolute_get_remaining (th->transmit_timeout).rel_value_us) )
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Transmit to `%s' fails, time out reached (%p).\n",
+         GNUNET_a2s (connection->addr,
+                     connection->addrlen),
+         connection);
+    notify = th->notify_ready;
+    th->notify_ready = NULL;
+    notify (th->notify_ready_cls, 0, NULL);
+    return;
+  }
+  if (GNUNET_YES ==
+      GNUNET_SHM_ring_wait_write_ (connection->shm,
+                                   connection->shm_tx))
+  {
+    connection->write_task =
+      GNUNET_SCHEDULER_add_now (&shm_transmit_ready,
+                                connection);
+    return;
+  }
+  /* wait for the reader to wake us up, see shm_wakeup() */
+  connection->write_task =
+    GNUNET_SCHEDULER_add_delayed ((NULL == th->notify_ready)
+                                  ? GNUNET_TIME_UNIT_FOREVER_REL
+                                  : GNUNET_TIME_absolute_get_remaining (th->transmit_timeout),
+                                  &shm_transmit_ready,
+                                  connection);
+  return;
+ CORRUPT:
+  shm_corrupt (connection);
+ FAIL:
+  connection->write_buffer_pos = 0;
+  connection->write_buffer_off = 0;
+  if (NULL == (notify = th->notify_ready))
+    return;
+  th->notify_ready = NULL;
+  notify (th->notify_ready_cls, 0, NULL);
+}
+
+
+/**
+ * Schedule the task that will serve the pending transmit request
+ * of a connected @a connection.
+ *
+ * @param connection connection with a pending transmit request
+ */
+static void
+schedule_transmit (struct GNUNET_CONNECTION_Handle *connection)
+{
+  if (SHM_STATE_ACTIVE == connection->shm_state)
+  {
+    /* re-evaluate now, we may be waiting for a wakeup without timeout */
+    if (NULL != connection->write_task)
+      GNUNET_SCHEDULER_cancel (connection->write_task);
+    connection->write_task =
+      GNUNET_SCHEDULER_add_now (&shm_transmit_ready,
+                                connection);
+    return;
+  }
+  GNUNET_assert (NULL == connection->write_task);
+  connection->write_task =
+    GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_absolute_get_remaining
+                                    (connection->nth.transmit_timeout),
+                                    connection->sock,
+                                    &transmit_ready,
+                                    connection);
+}
+
+
+/**
+ * The other side wrote to the socket: either a wakeup, or it
+ * closed the connection.  Look at the rings again.
+ *
+ * @param cls connection using shared memory
+ * @param tc scheduler context
+ */
+static void
+shm_wakeup (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CONNECTION_Handle *connection = cls;
+  char buf[64];
+  ssize_t ret;
+
+  connection->shm_task = NULL;
+  if (0 != (tc->reason & GNUNET_SCHEDULER_REASON_READ_READY))
+  {
+    ret = GNUNET_NETWORK_socket_recv (connection->sock,
+                                      buf,
+                                      sizeof (buf));
+    if ( (0 == ret) ||
+         ( (-1 == ret) &&
+           (EINTR != errno) &&
+           (EAGAIN != errno) ) )
+      connection->shm_eof = GNUNET_YES;
+  }
+  if (GNUNET_YES != connection->shm_eof)
+    connection->shm_task =
+      GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                     connection->sock,
+                                     &shm_wakeup,
+                                     connection);
+  if (NULL != connection->read_task)
+  {
+    GNUNET_SCHEDULER_cancel (connection->read_task);
+    connection->read_task =
+      GNUNET_SCHEDULER_add_now (&shm_receive_ready,
+                                connection);
+  }
+  if (NULL != connection->write_task)
+  {
+    GNUNET_SCHEDULER_cancel (connection->write_task);
+    connection->write_task =
+      GNUNET_SCHEDULER_add_now (&shm_transmit_ready,
+                                connection);
+  }
+}
+
+
+/**
+ * We are done negotiating shared memory; continue with the receive
+ * and transmit requests that waited for it.
+ *
+ * @param connection the connection
+ * @param state #SHM_STATE_NONE or #SHM_STATE_ACTIVE
+ */
+static void
+shm_finish (struct GNUNET_CONNECTION_Handle *connection,
+            enum ShmState state)
+{
+  if ( (SHM_STATE_ACTIVE != state) &&
+       (NULL != connection->shm) )
+  {
+    GNUNET_SHM_segment_destroy_ (connection->shm);
+    connection->shm = NULL;
+  }
+  connection->shm_state = state;
+  if (SHM_STATE_ACTIVE == state)
+  {
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Using shared memory for connection to `%s' (%p)\n",
+         GNUNET_a2s (connection->addr, connection->addrlen),
+         connection);
+    connection->shm_task =
+      GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                     connection->sock,
+                                     &shm_wakeup,
+                                     connection);
+  }
+  if (NULL != connection->receiver)
+  {
+    GNUNET_SCHEDULER_cancel (connection->read_task);
+    connection->read_task = NULL;
+    schedule_receive (connection);
+  }
+  if (NULL != connection->nth.timeout_task)
+  {
+    GNUNET_SCHEDULER_cancel (connection->nth.timeout_task);
+    connection->nth.timeout_task = NULL;
+    schedule_transmit (connection);
+  }
+}
+
+
+/**
+ * Read the negotiation message from the other side (or whatever
+ * the other side sent instead).
+ *
+ * @param cls connection that negotiates shared memory
+ * @param tc scheduler context
+ */
+static void
+shm_negotiate (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CONNECTION_Handle *connection = cls;
+  struct ShmMessage msg;
+  ssize_t ret;
+
+  connection->shm_task = NULL;
+  if (0 == (tc->reason & GNUNET_SCHEDULER_REASON_READ_READY))
+    goto AGAIN;                 /* ignore shutdown */
+  ret = GNUNET_SHM_segment_recv_ (connection->sock,
+                                  &connection->shm_buf[connection->shm_buf_len],
+                                  sizeof (msg) - connection->shm_buf_len,
+                                  (SHM_STATE_PROBE == connection->shm_state)
+                                  ? &connection->shm
+                                  : NULL);
+  if ( (-1 == ret) &&
+       ( (EINTR == errno) ||
+         (EAGAIN == errno) ) )
+    goto AGAIN;
+  if (0 >= ret)
+  {
+    /* error or EOF, the regular code will find out again */
+    if (SHM_STATE_OFFERED == connection->shm_state)
+      connection->shm_buf_len = 0;
+    shm_finish (connection, SHM_STATE_NONE);
+    return;
+  }
+  connection->shm_buf_len += ret;
+  if (connection->shm_buf_len < sizeof (struct GNUNET_MessageHeader))
+    goto AGAIN;
+  memcpy (&msg, connection->shm_buf, sizeof (struct GNUNET_MessageHeader));
+  if ( (GNUNET_MESSAGE_TYPE_CONNECTION_SHM != ntohs (msg.header.type)) ||
+       (sizeof (msg) != ntohs (msg.header.size)) )
+  {
+    /* the other side does not negotiate, these are ordinary data */
+    if (SHM_STATE_OFFERED == connection->shm_state)
+      LOG (GNUNET_ERROR_TYPE_WARNING,
+           _("Service at `%s' does not answer our offer of shared memory, is `%s' set for both?\n"),
+           GNUNET_a2s (connection->addr, connection->addrlen),
+           "SHM_IPC");
+    shm_finish (connection, SHM_STATE_NONE);
+    return;
+  }
+  if (connection->shm_buf_len < sizeof (msg))
+    goto AGAIN;
+  memcpy (&msg, connection->shm_buf, sizeof (msg));
+  connection->shm_buf_len = 0;
+  if (SHM_STATE_OFFERED == connection->shm_state)
+  {
+    if (GNUNET_YES != ntohl (msg.accepted))
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Service at `%s' declined shared memory (%p)\n",
+           GNUNET_a2s (connection->addr, connection->addrlen),
+           connection);
+      shm_finish (connection, SHM_STATE_NONE);
+      return;
+    }
+    connection->shm_tx = GNUNET_SHM_CLIENT_TO_SERVICE;
+    connection->shm_rx = GNUNET_SHM_SERVICE_TO_CLIENT;
+    shm_finish (connection, SHM_STATE_ACTIVE);
+    return;
+  }
+  /* the client made an offer, answer it before anything else */
+  msg.accepted = htonl ((NULL != connection->shm) ? GNUNET_YES : GNUNET_NO);
+  if (sizeof (msg) !=
+      GNUNET_NETWORK_socket_send (connection->sock,
+                                  &msg,
+                                  sizeof (msg)))
+  {
+    /* nothing else was sent yet, so this should never happen */
+    LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING,
+                  "send");
+    (void) GNUNET_NETWORK_socket_shutdown (connection->sock,
+                                           SHUT_RDWR);
+    shm_finish (connection, SHM_STATE_NONE);
+    return;
+  }
+  if (NULL == connection->shm)
+  {
+    shm_finish (connection, SHM_STATE_NONE);
+    return;
+  }
+  connection->shm_tx = GNUNET_SHM_SERVICE_TO_CLIENT;
+  connection->shm_rx = GNUNET_SHM_CLIENT_TO_SERVICE;
+  shm_finish (connection, SHM_STATE_ACTIVE);
+  return;
+ AGAIN:
+  connection->shm_task =
+    GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                   connection->sock,
+                                   &shm_negotiate,
+                                   connection);
+}
+
+
 /**
  * Ask the connection to call us once the specified number of bytes
  * are free in the transmission buffer.  Will never call the @a notify
@@ -1524,9 +2471,17 @@ GNUNET_CONNECTION_notify_transmit_ready (struct GNUNET_CONNECTION_Handle *connec
                                                        connection);
     return &connection->nth;
   }
-  if (NULL != connection->write_task)
+  if ( (NULL != connection->write_task) &&
+       (SHM_STATE_ACTIVE != connection->shm_state) )
     return &connection->nth; /* previous transmission still in progress */
-  if (NULL != connection->sock)
+  if ( (NULL != connection->sock) &&
+       (SHM_STATE_ACTIVE == connection->shm_state) )
+  {
+    schedule_transmit (connection);
+    return &connection->nth;
+  }
+  if ( (NULL != connection->sock) &&
+       (SHM_STATE_NONE == connection->shm_state) )
   {
     /* connected, try to transmit now */
     LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -1538,7 +2493,7 @@ GNUNET_CONNECTION_notify_transmit_ready (struct GNUNET_CONNECTION_Handle *connec
                                         connection->sock, &transmit_ready, connection);
     return &connection->nth;
   }
-  /* not yet connected, wait for connection */
+  /* not yet connected (or still negotiating shared memory), wait */
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Need to wait to schedule transmission for connection, adding timeout task (%p).\n",
        connection);
@@ -1557,6 +2512,11 @@ GNUNET_CONNECTION_notify_transmit_ready (struct GNUNET_CONNECTION_Handle *connec
 void
 GNUNET_CONNECTION_notify_transmit_ready_cancel (struct GNUNET_CONNECTION_TransmitHandle *th)
 {
+  struct GNUNET_CONNECTION_Handle *connection = th->connection;
+  const char *rest;
+  size_t used;
+  size_t len;
+
   GNUNET_assert (NULL != th->notify_ready);
   th->notify_ready = NULL;
   if (NULL != th->timeout_task)
@@ -1564,6 +2524,48 @@ GNUNET_CONNECTION_notify_transmit_ready_cancel (struct GNUNET_CONNECTION_Transmi
     GNUNET_SCHEDULER_cancel (th->timeout_task);
     th->timeout_task = NULL;
   }
+  if ( (NULL != th->cont) &&
+       (0 < th->msg_off) )
+  {
+    /* message partially transmitted, buffer the rest to keep
+       the stream intact */
+    rest = &((const char *) th->msgs[th->msg_pos])[th->msg_off];
+    len = ntohs (th->msgs[th->msg_pos]->size) - th->msg_off;
+    used = connection->write_buffer_off - connection->write_buffer_pos;
+    memmove (connection->write_buffer,
+             &connection->write_buffer[connection->write_buffer_pos],
+             used);
+    connection->write_buffer_pos = 0;
+    connection->write_buffer_off = used;
+    if (connection->write_buffer_size < used + len)
+    {
+      connection->write_buffer = GNUNET_realloc (connection->write_buffer,
+                                                 used + len);
+      connection->write_buffer_size = used + len;
+    }
+    memcpy (&connection->write_buffer[used],
+            rest,
+            len);
+    connection->write_buffer_off += len;
+    th->cont = NULL;
+    if (SHM_STATE_ACTIVE == connection->shm_state)
+      schedule_transmit (connection);
+    else if (NULL == connection->write_task)
+      connection->write_task =
+        GNUNET_SCHEDULER_add_write_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                        connection->sock,
+                                        &transmit_ready,
+                                        connection);
+    return;
+  }
+  th->cont = NULL;
+  if ( (SHM_STATE_ACTIVE == connection->shm_state) &&
+       (0 < connection->write_buffer_off) )
+  {
+    /* keep moving buffered data into the ring */
+    schedule_transmit (connection);
+    return;
+  }
   if (NULL != th->connection->write_task)
   {
     GNUNET_SCHEDULER_cancel (th->connection->write_task);
@@ -1572,6 +2574,135 @@ GNUNET_CONNECTION_notify_transmit_ready_cancel (struct GNUNET_CONNECTION_Transmi
 }
 
 
+/**
+ * Transmit messages without copying them into the write buffer
+ * of the connection.
+ *
+ * @param connection connection
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up if we cannot
+ *        start the transmission?
+ * @param cont function to call once the messages were sent
+ * @param cont_cls closure for @a cont
+ * @return non-NULL if the transmission was queued,
+ *         NULL if we are already going to notify someone else (busy)
+ */
+struct GNUNET_CONNECTION_TransmitHandle *
+GNUNET_CONNECTION_transmit_messages (struct GNUNET_CONNECTION_Handle *connection,
+                                     const struct GNUNET_MessageHeader *const *msgs,
+                                     unsigned int count,
+                                     struct GNUNET_TIME_Relative timeout,
+                                     GNUNET_CONNECTION_TransmitContinuation cont,
+                                     void *cont_cls)
+{
+  struct GNUNET_CONNECTION_TransmitHandle *th;
+
+  GNUNET_assert ( (0 < count) &&
+                  (GNUNET_CONNECTION_MAX_MESSAGES >= count) );
+  GNUNET_assert (NULL != cont);
+  /* errors are reported through transmit_messages_failed(),
+     transmit_ready() takes care of the rest */
+  th = GNUNET_CONNECTION_notify_transmit_ready (connection,
+                                                0,
+                                                timeout,
+                                                &transmit_messages_failed,
+                                                connection);
+  if (NULL == th)
+    return NULL;
+  memcpy (th->msgs,
+          msgs,
+          count * sizeof (const struct GNUNET_MessageHeader *));
+  th->msg_count = count;
+  th->msg_pos = 0;
+  th->msg_off = 0;
+  th->cont = cont;
+  th->cont_cls = cont_cls;
+  return th;
+}
+
+
+/**
+ * Offer the service we just connected to (via a UNIX domain socket)
+ * to exchange data through shared memory instead of the socket.
+ * Must be called before anything else is done with the connection.
+ * Until the service answered, transmissions and receptions wait.
+ *
+ * @param connection fresh connection to a service
+ */
+void
+GNUNET_CONNECTION_shm_offer_ (struct GNUNET_CONNECTION_Handle *connection)
+{
+  struct ShmMessage msg;
+  ssize_t ret;
+
+  if ( (NULL == connection->sock) ||
+       (NULL == connection->addr) ||
+       (AF_UNIX != connection->addr->sa_family) ||
+       (SHM_STATE_NONE != connection->shm_state) ||
+       (NULL != connection->receiver) ||
+       (NULL != connection->nth.notify_ready) ||
+       (0 != connection->write_buffer_off) )
+    return;
+  if (NULL == (connection->shm = GNUNET_SHM_segment_create_ ()))
+    return;
+  msg.header.size = htons (sizeof (msg));
+  msg.header.type = htons (GNUNET_MESSAGE_TYPE_CONNECTION_SHM);
+  msg.accepted = htonl (GNUNET_NO);
+  ret = GNUNET_SHM_segment_send_ (connection->shm,
+                                  connection->sock,
+                                  &msg,
+                                  sizeof (msg));
+  if (sizeof (msg) != ret)
+  {
+    /* typically, the connect() is still in progress; as long as
+       nothing was sent, we simply stay with the socket */
+    LOG (GNUNET_ERROR_TYPE_DEBUG,
+         "Could not offer shared memory to `%s': %s\n",
+         GNUNET_a2s (connection->addr, connection->addrlen),
+         (-1 == ret) ? STRERROR (errno) : "short write");
+    if (0 < ret)
+      (void) GNUNET_NETWORK_socket_shutdown (connection->sock,
+                                             SHUT_RDWR);
+    GNUNET_SHM_segment_destroy_ (connection->shm);
+    connection->shm = NULL;
+    return;
+  }
+  connection->shm_state = SHM_STATE_OFFERED;
+  connection->shm_task =
+    GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                   connection->sock,
+                                   &shm_negotiate,
+                                   connection);
+}
+
+
+/**
+ * Check if the client on a freshly accepted UNIX domain connection
+ * offers shared memory, and accept the offer if possible.  Until the
+ * first bytes from the client arrived, transmissions wait; so this
+ * must only be used for protocols where the client speaks first.
+ *
+ * @param connection freshly accepted connection
+ */
+void
+GNUNET_CONNECTION_shm_probe_ (struct GNUNET_CONNECTION_Handle *connection)
+{
+  if ( (NULL == connection->sock) ||
+       (NULL == connection->addr) ||
+       (AF_UNIX != connection->addr->sa_family) ||
+       (SHM_STATE_NONE != connection->shm_state) )
+    return;
+  connection->shm_state = SHM_STATE_PROBE;
+  connection->shm_task =
+    GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL,
+                                   connection->sock,
+                                   &shm_negotiate,
+                                   connection);
+}
+
+
 /**
  * Create a connection to be proxied using a given connection.
  *
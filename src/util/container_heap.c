@@ -33,7 +33,18 @@
 #define EXTRA_CHECKS 0
 
 /**
- * Node in the heap.
+ * Number of children of each node in the heap.
+ */
+#define ARITY 4
+
+/**
+ * Initial (and minimum) number of entries allocated for a heap.
+ */
+#define MIN_CAPACITY 16
+
+/**
+ * Node in the heap.  The node is only a handle, the heap itself
+ * is kept in the `entries` array of the heap.
  */
 struct GNUNET_CONTAINER_HeapNode
 {
@@ -43,38 +54,37 @@ struct GNUNET_CONTAINER_HeapNode
   struct GNUNET_CONTAINER_Heap *heap;
 
   /**
-   * Parent node.
+   * Our element.
    */
-  struct GNUNET_CONTAINER_HeapNode *parent;
+  void *element;
 
   /**
-   * Left child.
+   * Position of this node in the entries of the heap.
    */
-  struct GNUNET_CONTAINER_HeapNode *left_child;
+  unsigned int index;
 
-  /**
-   * Right child.
-   */
-  struct GNUNET_CONTAINER_HeapNode *right_child;
+};
 
-  /**
-   * Our element.
-   */
-  void *element;
 
+/**
+ * Entry in the heap array.  We keep the cost next to the node
+ * pointer so that comparisons do not need to touch the nodes.
+ */
+struct HeapEntry
+{
   /**
    * Cost for this element.
    */
   GNUNET_CONTAINER_HeapCostType cost;
 
   /**
-   * Number of elements below this node in the heap
-   * (excluding this node itself).
+   * Node of the element, NULL if the node was removed
+   * while iterating over the heap.
    */
-  unsigned int tree_size;
-
+  struct GNUNET_CONTAINER_HeapNode *node;
 };
 
+
 /**
  * Handle to a node in a heap.
  */
@@ -82,20 +92,39 @@ struct GNUNET_CONTAINER_Heap
 {
 
   /**
-   * Root of the heap.
+   * The heap, the root is at index 0 and the children of
+   * entry i are at ARITY*i+1 to ARITY*i+ARITY.
    */
-  struct GNUNET_CONTAINER_HeapNode *root;
+  struct HeapEntry *entries;
 
   /**
-   * Current position of our random walk.
+   * Number of entries allocated.
+   */
+  unsigned int capacity;
+
+  /**
+   * Number of entries used (including those of nodes removed
+   * while iterating).
    */
-  struct GNUNET_CONTAINER_HeapNode *walk_pos;
+  unsigned int used;
 
   /**
    * Number of elements in the heap.
    */
   unsigned int size;
 
+  /**
+   * Current position of our random walk.
+   */
+  unsigned int walk_pos;
+
+  /**
+   * Number of iterations over this heap in progress.  While
+   * iterating, removed nodes only leave a hole in @e entries
+   * which is closed once the iteration is done.
+   */
+  unsigned int iterating;
+
   /**
    * How is the heap sorted?
    */
@@ -104,33 +133,240 @@ struct GNUNET_CONTAINER_Heap
 };
 
 
+/**
+ * Pool for the heap nodes.
+ */
+static struct GNUNET_MemoryPool *node_pool;
+
+
+/**
+ * Should an entry with cost @a a be closer to the root
+ * than an entry with cost @a b?
+ *
+ * @param heap the heap
+ * @param a first cost
+ * @param b second cost
+ * @return non-zero if @a a goes first
+ */
+static int
+before (const struct GNUNET_CONTAINER_Heap *heap,
+        GNUNET_CONTAINER_HeapCostType a,
+        GNUNET_CONTAINER_HeapCostType b)
+{
+  if (GNUNET_CONTAINER_HEAP_ORDER_MAX == heap->order)
+    return a > b;
+  return a < b;
+}
+
+
 #if EXTRA_CHECKS
 /**
- * Check if internal invariants hold for the given node.
+ * Check if internal invariants hold for the given heap.
  *
- * @param node subtree to check
+ * @param heap heap to check
  */
 static void
-check (const struct GNUNET_CONTAINER_HeapNode *node)
+check (const struct GNUNET_CONTAINER_Heap *heap)
 {
-  if (NULL == node)
+  unsigned int i;
+
+  GNUNET_assert (heap->used <= heap->capacity);
+  if (0 != heap->iterating)
     return;
-  GNUNET_assert (node->tree_size ==
-                 ((node->left_child ==
-                   NULL) ? 0 : 1 + node->left_child->tree_size) +
-                 ((node->right_child ==
-                   NULL) ? 0 : 1 + node->right_child->tree_size));
-  check (node->left_child);
-  check (node->right_child);
+  GNUNET_assert (heap->size == heap->used);
+  for (i = 0; i < heap->used; i++)
+  {
+    GNUNET_assert (heap->entries[i].node->index == i);
+    GNUNET_assert (heap->entries[i].node->heap == heap);
+    if (i > 0)
+      GNUNET_assert (! before (heap, heap->entries[i].cost,
+                               heap->entries[(i - 1) / ARITY].cost));
+  }
 }
 
 
-#define CHECK(n) check(n)
+#define CHECK(h) check(h)
 #else
-#define CHECK(n) do {} while (0)
+#define CHECK(h) do {} while (0)
 #endif
 
 
+/**
+ * Move the entry at @a idx towards the root until its
+ * parent goes before it.
+ *
+ * @param heap heap to modify
+ * @param idx index of the entry to move
+ */
+static void
+sift_up (struct GNUNET_CONTAINER_Heap *heap,
+         unsigned int idx)
+{
+  struct HeapEntry e;
+  unsigned int parent;
+
+  e = heap->entries[idx];
+  while (idx > 0)
+  {
+    parent = (idx - 1) / ARITY;
+    if (! before (heap, e.cost, heap->entries[parent].cost))
+      break;
+    heap->entries[idx] = heap->entries[parent];
+    heap->entries[idx].node->index = idx;
+    idx = parent;
+  }
+  heap->entries[idx] = e;
+  e.node->index = idx;
+}
+
+
+/**
+ * Move the entry at @a idx away from the root until
+ * none of its children goes before it.
+ *
+ * @param heap heap to modify
+ * @param idx index of the entry to move
+ */
+static void
+sift_down (struct GNUNET_CONTAINER_Heap *heap,
+           unsigned int idx)
+{
+  struct HeapEntry e;
+  unsigned int first;
+  unsigned int last;
+  unsigned int best;
+  unsigned int c;
+
+  e = heap->entries[idx];
+  while (1)
+  {
+    first = idx * ARITY + 1;
+    if (first >= heap->used)
+      break;
+    last = GNUNET_MIN (first + ARITY, heap->used);
+    best = first;
+    for (c = first + 1; c < last; c++)
+      if (before (heap, heap->entries[c].cost, heap->entries[best].cost))
+        best = c;
+    if (! before (heap, heap->entries[best].cost, e.cost))
+      break;
+    heap->entries[idx] = heap->entries[best];
+    heap->entries[idx].node->index = idx;
+    idx = best;
+  }
+  heap->entries[idx] = e;
+  e.node->index = idx;
+}
+
+
+/**
+ * Restore the heap property for the entry at @a idx
+ * after its cost changed.
+ *
+ * @param heap heap to modify
+ * @param idx index of the changed entry
+ */
+static void
+update_position (struct GNUNET_CONTAINER_Heap *heap,
+                 unsigned int idx)
+{
+  if ( (idx > 0) &&
+       (before (heap, heap->entries[idx].cost,
+                heap->entries[(idx - 1) / ARITY].cost)) )
+    sift_up (heap, idx);
+  else
+    sift_down (heap, idx);
+}
+
+
+/**
+ * Change the number of allocated entries of @a heap.
+ *
+ * @param heap heap to modify
+ * @param capacity new number of entries, at least @e used
+ */
+static void
+resize_entries (struct GNUNET_CONTAINER_Heap *heap,
+                unsigned int capacity)
+{
+  GNUNET_assert (capacity >= heap->used);
+  GNUNET_assert (capacity < UINT_MAX / sizeof (struct HeapEntry));
+  heap->entries = GNUNET_realloc (heap->entries,
+                                  capacity * sizeof (struct HeapEntry));
+  heap->capacity = capacity;
+}
+
+
+/**
+ * Give back memory if the heap got much smaller.
+ *
+ * @param heap heap to check
+ */
+static void
+maybe_shrink (struct GNUNET_CONTAINER_Heap *heap)
+{
+  if ( (heap->capacity > MIN_CAPACITY) &&
+       (heap->used < heap->capacity / 4) )
+    resize_entries (heap, heap->capacity / 2);
+}
+
+
+/**
+ * Remove the entry at @a idx from the heap, replacing it
+ * with the last entry.  Must not be used while iterating.
+ *
+ * @param heap heap to modify
+ * @param idx index of the entry to remove
+ */
+static void
+remove_entry (struct GNUNET_CONTAINER_Heap *heap,
+              unsigned int idx)
+{
+  heap->used--;
+  heap->size--;
+  if (idx != heap->used)
+  {
+    heap->entries[idx] = heap->entries[heap->used];
+    heap->entries[idx].node->index = idx;
+    update_position (heap, idx);
+  }
+  if (heap->walk_pos >= heap->used)
+    heap->walk_pos = 0;
+  maybe_shrink (heap);
+}
+
+
+/**
+ * Close the holes left by nodes removed while iterating
+ * and restore the heap property.
+ *
+ * @param heap heap to modify
+ */
+static void
+compact (struct GNUNET_CONTAINER_Heap *heap)
+{
+  unsigned int i;
+  unsigned int j;
+
+  j = 0;
+  for (i = 0; i < heap->used; i++)
+  {
+    if (NULL == heap->entries[i].node)
+      continue;
+    heap->entries[j] = heap->entries[i];
+    heap->entries[j].node->index = j;
+    j++;
+  }
+  heap->used = j;
+  GNUNET_assert (heap->used == heap->size);
+  if (heap->used > 1)
+    for (i = (heap->used - 2) / ARITY + 1; i > 0; i--)
+      sift_down (heap, i - 1);
+  heap->walk_pos = 0;
+  maybe_shrink (heap);
+}
+
+
 /**
  * Create a new heap.
  *
@@ -158,6 +394,8 @@ void
 GNUNET_CONTAINER_heap_destroy (struct GNUNET_CONTAINER_Heap *heap)
 {
   GNUNET_break (heap->size == 0);
+  GNUNET_break (heap->iterating == 0);
+  GNUNET_free_non_null (heap->entries);
   GNUNET_free (heap);
 }
 
@@ -171,9 +409,10 @@ GNUNET_CONTAINER_heap_destroy (struct GNUNET_CONTAINER_Heap *heap)
 void *
 GNUNET_CONTAINER_heap_peek (const struct GNUNET_CONTAINER_Heap *heap)
 {
-  if (heap->root == NULL)
+  if ( (0 == heap->used) ||
+       (NULL == heap->entries[0].node) )
     return NULL;
-  return heap->root->element;
+  return heap->entries[0].node->element;
 }
 
 
@@ -191,12 +430,13 @@ GNUNET_CONTAINER_heap_peek2 (const struct GNUNET_CONTAINER_Heap *heap,
                              void **element,
                              GNUNET_CONTAINER_HeapCostType *cost)
 {
-  if (NULL == heap->root)
+  if ( (0 == heap->used) ||
+       (NULL == heap->entries[0].node) )
     return GNUNET_NO;
   if (NULL != element)
-    *element = heap->root->element;
+    *element = heap->entries[0].node->element;
   if (NULL != cost)
-    *cost = heap->root->cost;
+    *cost = heap->entries[0].cost;
   return GNUNET_YES;
 }
 
@@ -224,38 +464,14 @@ GNUNET_CONTAINER_HeapCostType
 GNUNET_CONTAINER_heap_node_get_cost (const struct GNUNET_CONTAINER_HeapNode
                                      *node)
 {
-  return node->cost;
+  return node->heap->entries[node->index].cost;
 }
 
 
 /**
- * Iterate over the children of the given node.
- *
- * @param heap argument to give to iterator
- * @param node node to iterate over
- * @param iterator function to call on each node
- * @param iterator_cls closure for iterator
- * @return GNUNET_YES to continue to iterate
- */
-static int
-node_iterator (const struct GNUNET_CONTAINER_Heap *heap,
-               struct GNUNET_CONTAINER_HeapNode *node,
-               GNUNET_CONTAINER_HeapIterator iterator, void *iterator_cls)
-{
-  if (node == NULL)
-    return GNUNET_YES;
-  if (GNUNET_YES !=
-      node_iterator (heap, node->left_child, iterator, iterator_cls))
-    return GNUNET_NO;
-  if (GNUNET_YES !=
-      node_iterator (heap, node->right_child, iterator, iterator_cls))
-    return GNUNET_NO;
-  return iterator (iterator_cls, node, node->element, node->cost);
-}
-
-
-/**
- * Iterate over all entries in the heap.
+ * Iterate over all entries in the heap.  The iterator may
+ * remove nodes (using #GNUNET_CONTAINER_heap_remove_node()),
+ * but must not otherwise modify the heap.
  *
  * @param heap the heap
  * @param iterator function to call on each entry
@@ -266,7 +482,25 @@ GNUNET_CONTAINER_heap_iterate (const struct GNUNET_CONTAINER_Heap *heap,
                                GNUNET_CONTAINER_HeapIterator iterator,
                                void *iterator_cls)
 {
-  (void) node_iterator (heap, heap->root, iterator, iterator_cls);
+  struct GNUNET_CONTAINER_Heap *h = (struct GNUNET_CONTAINER_Heap *) heap;
+  struct HeapEntry *e;
+  unsigned int i;
+
+  h->iterating++;
+  for (i = h->used; i > 0; i--)
+  {
+    e = &h->entries[i - 1];
+    if (NULL == e->node)
+      continue;
+    if (GNUNET_YES != iterator (iterator_cls, e->node, e->node->element,
+                                e->cost))
+      break;
+  }
+  h->iterating--;
+  if ( (0 == h->iterating) &&
+       (h->used != h->size) )
+    compact (h);
+  CHECK (h);
 }
 
 
@@ -284,81 +518,19 @@ GNUNET_CONTAINER_heap_iterate (const struct GNUNET_CONTAINER_Heap *heap,
 void *
 GNUNET_CONTAINER_heap_walk_get_next (struct GNUNET_CONTAINER_Heap *heap)
 {
-  struct GNUNET_CONTAINER_HeapNode *pos;
-  void *element;
+  unsigned int pos;
+  unsigned int child;
 
-  if (heap->root == NULL)
+  if (0 == heap->size)
     return NULL;
+  GNUNET_assert (0 == heap->iterating);
   pos = heap->walk_pos;
-  if (pos == NULL)
-    pos = heap->root;
-  element = pos->element;
-  heap->walk_pos =
-      (0 ==
-       GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-                                 2)) ? pos->right_child : pos->left_child;
-  return element;
-}
-
-
-/**
- * Insert the given node 'node' into the subtree starting
- * at 'pos' (while keeping the tree somewhat balanced).
- *
- * @param heap heap to modify
- * @param pos existing tree
- * @param node node to insert (which may be a subtree itself)
- */
-static void
-insert_node (struct GNUNET_CONTAINER_Heap *heap,
-             struct GNUNET_CONTAINER_HeapNode *pos,
-             struct GNUNET_CONTAINER_HeapNode *node)
-{
-  struct GNUNET_CONTAINER_HeapNode *parent;
-
-  GNUNET_assert (node->parent == NULL);
-  while ((heap->order == GNUNET_CONTAINER_HEAP_ORDER_MAX) ? (pos->cost >=
-                                                             node->cost)
-         : (pos->cost <= node->cost))
-  {
-    /* node is descendent of pos */
-    pos->tree_size += (1 + node->tree_size);
-    if (pos->left_child == NULL)
-    {
-      pos->left_child = node;
-      node->parent = pos;
-      return;
-    }
-    if (pos->right_child == NULL)
-    {
-      pos->right_child = node;
-      node->parent = pos;
-      return;
-    }
-    /* keep it balanced by descending into smaller subtree */
-    if (pos->left_child->tree_size < pos->right_child->tree_size)
-      pos = pos->left_child;
-    else
-      pos = pos->right_child;
-  }
-  /* make 'node' parent of 'pos' */
-  parent = pos->parent;
-  pos->parent = NULL;
-  node->parent = parent;
-  if (NULL == parent)
-  {
-    heap->root = node;
-  }
-  else
-  {
-    if (parent->left_child == pos)
-      parent->left_child = node;
-    else
-      parent->right_child = node;
-  }
-  /* insert 'pos' below 'node' */
-  insert_node (heap, node, pos);
-  CHECK (pos);
+  if (pos >= heap->used)
+    pos = 0;
+  child = pos * ARITY + 1
+    + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, ARITY);
+  heap->walk_pos = (child < heap->used) ? child : 0;
+  return heap->entries[pos].node->element;
 }
 
 
@@ -376,17 +548,18 @@ GNUNET_CONTAINER_heap_insert (struct GNUNET_CONTAINER_Heap *heap, void *element,
 {
   struct GNUNET_CONTAINER_HeapNode *node;
 
-  node = GNUNET_new (struct GNUNET_CONTAINER_HeapNode);
+  GNUNET_assert (0 == heap->iterating);
+  if (heap->used == heap->capacity)
+    resize_entries (heap, GNUNET_MAX (MIN_CAPACITY, 2 * heap->capacity));
+  node = GNUNET_pool_new (node_pool, struct GNUNET_CONTAINER_HeapNode);
   node->heap = heap;
   node->element = element;
-  node->cost = cost;
+  heap->entries[heap->used].cost = cost;
+  heap->entries[heap->used].node = node;
+  heap->used++;
   heap->size++;
-  if (NULL == heap->root)
-    heap->root = node;
-  else
-    insert_node (heap, heap->root, node);
-  GNUNET_assert (heap->size == heap->root->tree_size + 1);
-  CHECK (heap->root);
+  sift_up (heap, heap->used - 1);
+  CHECK (heap);
   return node;
 }
 
@@ -400,113 +573,21 @@ GNUNET_CONTAINER_heap_insert (struct GNUNET_CONTAINER_Heap *heap, void *element,
 void *
 GNUNET_CONTAINER_heap_remove_root (struct GNUNET_CONTAINER_Heap *heap)
 {
-  void *ret;
   struct GNUNET_CONTAINER_HeapNode *root;
+  void *ret;
 
-  if (NULL == (root = heap->root))
+  if (0 == heap->size)
     return NULL;
-  heap->size--;
+  GNUNET_assert (0 == heap->iterating);
+  root = heap->entries[0].node;
   ret = root->element;
-  if (root->left_child == NULL)
-  {
-    heap->root = root->right_child;
-    if (root->right_child != NULL)
-      root->right_child->parent = NULL;
-  }
-  else if (root->right_child == NULL)
-  {
-    heap->root = root->left_child;
-    root->left_child->parent = NULL;
-  }
-  else
-  {
-    root->left_child->parent = NULL;
-    root->right_child->parent = NULL;
-    heap->root = root->left_child;
-    insert_node (heap, heap->root, root->right_child);
-  }
-  if (heap->walk_pos == root)
-    heap->walk_pos = heap->root;
-  GNUNET_free (root);
-#if EXTRA_CHECKS
-  GNUNET_assert (((heap->size == 0) && (heap->root == NULL)) ||
-                 (heap->size == heap->root->tree_size + 1));
-  CHECK (heap->root);
-#endif
+  remove_entry (heap, 0);
+  GNUNET_pool_free (node_pool, root);
+  CHECK (heap);
   return ret;
 }
 
 
-/**
- * Remove the given node 'node' from the tree and update
- * the 'tree_size' fields accordingly.  Preserves the
- * children of 'node' and does NOT change the overall
- * 'size' field of the tree.
- */
-static void
-remove_node (struct GNUNET_CONTAINER_HeapNode *node)
-{
-  struct GNUNET_CONTAINER_HeapNode *ancestor;
-  struct GNUNET_CONTAINER_Heap *heap = node->heap;
-
-  /* update 'size' of the ancestors */
-  ancestor = node;
-  while (NULL != (ancestor = ancestor->parent))
-    ancestor->tree_size--;
-
-  /* update 'size' of node itself */
-  if (node->left_child != NULL)
-    node->tree_size -= (1 + node->left_child->tree_size);
-  if (node->right_child != NULL)
-    node->tree_size -= (1 + node->right_child->tree_size);
-
-  /* unlink 'node' itself and insert children in its place */
-  if (node->parent == NULL)
-  {
-    if (node->left_child != NULL)
-    {
-      heap->root = node->left_child;
-      node->left_child->parent = NULL;
-      if (node->right_child != NULL)
-      {
-        node->right_child->parent = NULL;
-        insert_node (heap, heap->root, node->right_child);
-      }
-    }
-    else
-    {
-      heap->root = node->right_child;
-      if (node->right_child != NULL)
-        node->right_child->parent = NULL;
-    }
-  }
-  else
-  {
-    if (node->parent->left_child == node)
-      node->parent->left_child = NULL;
-    else
-      node->parent->right_child = NULL;
-    if (node->left_child != NULL)
-    {
-      node->left_child->parent = NULL;
-      node->parent->tree_size -= (1 + node->left_child->tree_size);
-      insert_node (heap, node->parent, node->left_child);
-    }
-    if (node->right_child != NULL)
-    {
-      node->right_child->parent = NULL;
-      node->parent->tree_size -= (1 + node->right_child->tree_size);
-      insert_node (heap, node->parent, node->right_child);
-    }
-  }
-  node->parent = NULL;
-  node->left_child = NULL;
-  node->right_child = NULL;
-  GNUNET_assert (node->tree_size == 0);
-  CHECK (heap->root);
-}
-
-
 /**
  * Removes a node from the heap.
  *
@@ -516,24 +597,23 @@ remove_node (struct GNUNET_CONTAINER_HeapNode *node)
 void *
 GNUNET_CONTAINER_heap_remove_node (struct GNUNET_CONTAINER_HeapNode *node)
 {
-  void *ret;
   struct GNUNET_CONTAINER_Heap *heap;
+  void *ret;
 
   heap = node->heap;
-  CHECK (heap->root);
-  if (heap->walk_pos == node)
-    (void) GNUNET_CONTAINER_heap_walk_get_next (heap);
-  remove_node (node);
-  heap->size--;
   ret = node->element;
-  if (heap->walk_pos == node)
-    heap->walk_pos = NULL;
-  GNUNET_free (node);
-#if EXTRA_CHECKS
-  CHECK (heap->root);
-  GNUNET_assert (((heap->size == 0) && (heap->root == NULL)) ||
-                 (heap->size == heap->root->tree_size + 1));
-#endif
+  if (0 != heap->iterating)
+  {
+    /* leave a hole, closed once the iteration is done */
+    heap->entries[node->index].node = NULL;
+    heap->size--;
+  }
+  else
+  {
+    remove_entry (heap, node->index);
+  }
+  GNUNET_pool_free (node_pool, node);
+  CHECK (heap);
   return ret;
 }
 
@@ -550,27 +630,11 @@ GNUNET_CONTAINER_heap_update_cost (struct GNUNET_CONTAINER_Heap *heap,
                                    struct GNUNET_CONTAINER_HeapNode *node,
                                    GNUNET_CONTAINER_HeapCostType new_cost)
 {
-#if EXTRA_CHECKS
-  GNUNET_assert (((heap->size == 0) && (heap->root == NULL)) ||
-                 (heap->size == heap->root->tree_size + 1));
-  CHECK (heap->root);
-#endif
-  remove_node (node);
-#if EXTRA_CHECKS
-  CHECK (heap->root);
-  GNUNET_assert (((heap->size == 1) && (heap->root == NULL)) ||
-                 (heap->size == heap->root->tree_size + 2));
-#endif
-  node->cost = new_cost;
-  if (heap->root == NULL)
-    heap->root = node;
-  else
-    insert_node (heap, heap->root, node);
-#if EXTRA_CHECKS
-  CHECK (heap->root);
-  GNUNET_assert (((heap->size == 0) && (heap->root == NULL)) ||
-                 (heap->size == heap->root->tree_size + 1));
-#endif
+  GNUNET_assert (0 == heap->iterating);
+  GNUNET_assert (heap == node->heap);
+  heap->entries[node->index].cost = new_cost;
+  update_position (heap, node->index);
+  CHECK (heap);
 }
 
 
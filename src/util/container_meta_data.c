@@ -106,6 +106,12 @@ struct GNUNET_CONTAINER_MetaData
    */
   size_t sbuf_size;
 
+  /**
+   * #GNUNET_YES if 'sbuf' was built without trying compression
+   * (#GNUNET_CONTAINER_META_DATA_SERIALIZE_NO_COMPRESS).
+   */
+  int sbuf_no_compress;
+
   /**
    * Number of items in the linked list.
    */
@@ -155,6 +161,7 @@ invalidate_sbuf (struct GNUNET_CONTAINER_MetaData *md)
   GNUNET_free (md->sbuf);
   md->sbuf = NULL;
   md->sbuf_size = 0;
+  md->sbuf_no_compress = GNUNET_NO;
 }
 
 
@@ -588,14 +595,37 @@ GNUNET_CONTAINER_meta_data_duplicate (const struct GNUNET_CONTAINER_MetaData
 {
   struct GNUNET_CONTAINER_MetaData *ret;
   struct MetaItem *pos;
+  struct MetaItem *mi;
 
   if (NULL == md)
     return NULL;
   ret = GNUNET_CONTAINER_meta_data_create ();
-  for (pos = md->items_tail; NULL != pos; pos = pos->prev)
-    GNUNET_CONTAINER_meta_data_insert (ret, pos->plugin_name, pos->type,
-                                       pos->format, pos->mime_type, pos->data,
-                                       pos->data_size);
+  /* copy the items in order (they are already sorted and unique), so
+   * that the serialization buffer remains valid for the copy */
+  for (pos = md->items_head; NULL != pos; pos = pos->next)
+  {
+    mi = GNUNET_new (struct MetaItem);
+    mi->type = pos->type;
+    mi->format = pos->format;
+    mi->data_size = pos->data_size;
+    mi->mime_type =
+        (NULL == pos->mime_type) ? NULL : GNUNET_strdup (pos->mime_type);
+    mi->plugin_name =
+        (NULL == pos->plugin_name) ? NULL : GNUNET_strdup (pos->plugin_name);
+    mi->data = GNUNET_malloc (pos->data_size);
+    memcpy (mi->data, pos->data, pos->data_size);
+    GNUNET_CONTAINER_DLL_insert_tail (ret->items_head,
+                                      ret->items_tail,
+                                      mi);
+  }
+  ret->item_count = md->item_count;
+  if (NULL != md->sbuf)
+  {
+    ret->sbuf = GNUNET_malloc (md->sbuf_size);
+    memcpy (ret->sbuf, md->sbuf, md->sbuf_size);
+    ret->sbuf_size = md->sbuf_size;
+    ret->sbuf_no_compress = md->sbuf_no_compress;
+  }
   return ret;
 }
 
@@ -723,6 +753,29 @@ struct MetaDataEntry
 };
 
 
+/**
+ * Check if the cached serialization buffer of @a md is what a full
+ * serialization with the given options would produce.
+ *
+ * @param md metadata to check
+ * @param opt serialization options
+ * @return #GNUNET_YES if 'sbuf' can be used
+ */
+static int
+sbuf_matches (const struct GNUNET_CONTAINER_MetaData *md,
+              enum GNUNET_CONTAINER_MetaDataSerializationOptions opt)
+{
+  const struct MetaDataHeader *hdr;
+
+  if (NULL == md->sbuf)
+    return GNUNET_NO;
+  if (0 == (opt & GNUNET_CONTAINER_META_DATA_SERIALIZE_NO_COMPRESS))
+    return (GNUNET_YES == md->sbuf_no_compress) ? GNUNET_NO : GNUNET_YES;
+  hdr = (const struct MetaDataHeader *) md->sbuf;
+  return (0 != (ntohl (hdr->version) & HEADER_COMPRESSED)) ? GNUNET_NO : GNUNET_YES;
+}
+
+
 /**
  * Serialize meta-data to target.
  *
@@ -762,13 +815,15 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
   size_t clen;
   size_t rlen;
   int comp;
+  int have_sbuf;
 
   if (max < sizeof (struct MetaDataHeader))
     return GNUNET_SYSERR;       /* far too small */
   if (NULL == md)
     return 0;
 
-  if (NULL != md->sbuf)
+  have_sbuf = sbuf_matches (md, opt);
+  if (GNUNET_YES == have_sbuf)
   {
     /* try to use serialization cache */
     if (md->sbuf_size <= max)
@@ -780,7 +835,8 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
     }
     if (0 == (opt & GNUNET_CONTAINER_META_DATA_SERIALIZE_PART))
       return GNUNET_SYSERR;     /* can say that this will fail */
-    /* need to compute a partial serialization, sbuf useless ... */
+    /* need to compute a partial serialization; we already know that
+     * the full one does not fit, so we will skip trying that */
   }
   dst = NULL;
   msize = 0;
@@ -844,16 +900,23 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
   i = 0;
   for (pos = md->items_head; NULL != pos; pos = pos->next)
   {
+    if ( (0 == i) &&
+         (GNUNET_YES == have_sbuf) )
+      goto skip;                /* known not to fit, see above */
     comp = GNUNET_NO;
     if (0 == (opt & GNUNET_CONTAINER_META_DATA_SERIALIZE_NO_COMPRESS))
       comp = try_compression ((const char *) &ent[i], left, &cdata, &clen);
 
-    if ((NULL == md->sbuf) && (0 == i))
+    if (0 == i)
     {
       /* fill 'sbuf'; this "modifies" md, but since this is only
        * an internal cache we will cast away the 'const' instead
        * of making the API look strange. */
       vmd = (struct GNUNET_CONTAINER_MetaData *) md;
+      invalidate_sbuf (vmd);
+      vmd->sbuf_no_compress =
+          (0 != (opt & GNUNET_CONTAINER_META_DATA_SERIALIZE_NO_COMPRESS))
+          ? GNUNET_YES : GNUNET_NO;
       hdr = GNUNET_malloc (left + sizeof (struct MetaDataHeader));
       hdr->size = htonl (left);
       hdr->entries = htonl (md->item_count);
@@ -874,7 +937,8 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
     }
 
     if (((left + sizeof (struct MetaDataHeader)) <= max) ||
-        ((GNUNET_YES == comp) && (clen <= max)))
+        ((GNUNET_YES == comp) &&
+         (clen + sizeof (struct MetaDataHeader) <= max)))
     {
       /* success, this now fits! */
       if (GNUNET_YES == comp)
@@ -925,6 +989,9 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
       return GNUNET_SYSERR;
     }
 
+    GNUNET_free_non_null (cdata);
+    cdata = NULL;
+  skip:
     /* next iteration: ignore the corresponding meta data at the
      * end and try again without it */
     left -= sizeof (struct MetaDataEntry);
@@ -933,10 +1000,6 @@ GNUNET_CONTAINER_meta_data_serialize (const struct GNUNET_CONTAINER_MetaData
       left -= strlen (pos->plugin_name) + 1;
     if (NULL != pos->mime_type)
       left -= strlen (pos->mime_type) + 1;
-
-    GNUNET_free_non_null (cdata);
-    cdata = NULL;
-
     i++;
   }
   GNUNET_free (ent);
@@ -965,7 +1028,8 @@ GNUNET_CONTAINER_meta_data_get_serialized_size (const struct
   ssize_t ret;
   char *ptr;
 
-  if (NULL != md->sbuf)
+  if (GNUNET_YES ==
+      sbuf_matches (md, GNUNET_CONTAINER_META_DATA_SERIALIZE_FULL))
     return md->sbuf_size;
   ptr = NULL;
   ret =
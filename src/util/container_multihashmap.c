@@ -1,6 +1,6 @@
 /*
      This file is part of GNUnet.
-     Copyright (C) 2008, 2012 Christian Grothoff (and other contributing authors)
+     Copyright (C) 2008, 2012, 2015 Christian Grothoff (and other contributing authors)
 
      GNUnet is free software; you can redistribute it and/or modify
      it under the terms of the GNU General Public License as published
@@ -21,6 +21,15 @@
  * @file util/container_multihashmap.c
  * @brief hash map where the same key may be present multiple times
  * @author Christian Grothoff
+ *
+ * The map uses open addressing with Robin Hood hashing: entries are
+ * stored directly in the slot array, and a compact array of
+ * `struct SlotInfo` (hash prefix and probe distance) is scanned
+ * during lookups, so that most probes never touch the entries.
+ * Removal uses backward shifting and thus leaves no tombstones.
+ * While an iteration is running, removed slots are only marked as
+ * deleted (so that the iteration neither skips nor repeats entries)
+ * and are compacted once the outermost iteration finishes.
  */
 
 #include "platform.h"
@@ -29,26 +38,61 @@
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
 /**
- * An entry in the hash map with the full key.
+ * Flag set in `struct SlotInfo` for slots whose entry was removed
+ * while the map was being iterated over.
  */
-struct BigMapEntry
+#define SLOT_DELETED 0x80000000U
+
+/**
+ * Grow the map once more than this many eighths of the slots
+ * are in use.
+ */
+#define MAX_LOAD_EIGHTHS 7
+
+/**
+ * How many keys ahead do the batch operations prefetch slots?
+ */
+#define PREFETCH_DISTANCE 8
+
+
+/**
+ * Per-slot information, kept separate from the entries so that
+ * probing is cache-friendly.
+ */
+struct SlotInfo
 {
 
   /**
-   * Value of the entry.
+   * First 32 bits of the key of the entry in the slot.
    */
-  void *value;
+  uint32_t hash;
 
   /**
-   * If there is a hash collision, we create a linked list.
+   * 0 if the slot is empty, otherwise one plus the distance of the
+   * slot from the home slot of its key (possibly with
+   * #SLOT_DELETED set).
    */
-  struct BigMapEntry *next;
+  uint32_t dist;
+
+};
+
+
+/**
+ * An entry in the hash map with the full key.
+ */
+struct BigMapEntry
+{
 
   /**
    * Key for the entry.
    */
   struct GNUNET_HashCode key;
 
+  /**
+   * Value of the entry.
+   */
+  void *value;
+
 };
 
 
@@ -63,11 +107,6 @@ struct SmallMapEntry
    */
   void *value;
 
-  /**
-   * If there is a hash collision, we create a linked list.
-   */
-  struct SmallMapEntry *next;
-
   /**
    * Key for the entry.
    */
@@ -77,7 +116,7 @@ struct SmallMapEntry
 
 
 /**
- * Entry in the map.
+ * Array of entries in the map.
  */
 union MapEntry
 {
@@ -93,15 +132,37 @@ union MapEntry
 };
 
 
+/**
+ * A single entry, used while moving entries around in the map.
+ */
+union EntryCopy
+{
+  /**
+   * Variant used if map entries only contain a pointer to the key.
+   */
+  struct SmallMapEntry sme;
+
+  /**
+   * Variant used if map entries contain the full key.
+   */
+  struct BigMapEntry bme;
+};
+
+
 /**
  * Internal representation of the hash map.
  */
 struct GNUNET_CONTAINER_MultiHashMap
 {
   /**
-   * All of our buckets.
+   * All of our slots.
    */
-  union MapEntry *map;
+  union MapEntry map;
+
+  /**
+   * Information about each of our slots.
+   */
+  struct SlotInfo *info;
 
   /**
    * Number of entries in the map.
@@ -109,10 +170,26 @@ struct GNUNET_CONTAINER_MultiHashMap
   unsigned int size;
 
   /**
-   * Length of the "map" array.
+   * Length of the "map" array, always a power of two.
    */
   unsigned int map_length;
 
+  /**
+   * Number of slots marked with #SLOT_DELETED.
+   */
+  unsigned int deleted;
+
+  /**
+   * Number of iterations over the map currently running.
+   */
+  unsigned int iterating;
+
+  /**
+   * #GNUNET_YES if the map was destroyed while being iterated over,
+   * it is then freed once the iteration finishes.
+   */
+  int destroy_pending;
+
   /**
    * #GNUNET_NO if the map entries are of type 'struct BigMapEntry',
    * #GNUNET_YES if the map entries are of type 'struct SmallMapEntry'.
@@ -134,12 +211,7 @@ struct GNUNET_CONTAINER_MultiHashMap
 struct GNUNET_CONTAINER_MultiHashMapIterator
 {
   /**
-   * Position in the bucket 'idx'
-   */
-  union MapEntry me;
-
-  /**
-   * Current bucket index.
+   * Current slot index.
    */
   unsigned int idx;
 
@@ -156,6 +228,25 @@ struct GNUNET_CONTAINER_MultiHashMapIterator
 };
 
 
+/**
+ * Allocate the slot arrays of @a map for @a len slots.
+ *
+ * @param map the map
+ * @param len number of slots, must be a power of two
+ */
+static void
+alloc_slots (struct GNUNET_CONTAINER_MultiHashMap *map,
+             unsigned int len)
+{
+  map->map_length = len;
+  map->info = GNUNET_malloc (len * sizeof (struct SlotInfo));
+  if (map->use_small_entries)
+    map->map.sme = GNUNET_malloc (len * sizeof (struct SmallMapEntry));
+  else
+    map->map.bme = GNUNET_malloc (len * sizeof (struct BigMapEntry));
+}
+
+
 /**
  * Create a multi hash map.
  *
@@ -176,12 +267,14 @@ GNUNET_CONTAINER_multihashmap_create (unsigned int len,
 				      int do_not_copy_keys)
 {
   struct GNUNET_CONTAINER_MultiHashMap *map;
+  unsigned int slots;
 
   GNUNET_assert (len > 0);
+  GNUNET_assert (len <= (1U << 30));
+  for (slots = 4; slots < len; slots *= 2) ;
   map = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMap);
-  map->map = GNUNET_malloc (len * sizeof (union MapEntry));
-  map->map_length = len;
   map->use_small_entries = do_not_copy_keys;
+  alloc_slots (map, slots);
   return map;
 }
 
@@ -196,57 +289,168 @@ void
 GNUNET_CONTAINER_multihashmap_destroy (struct GNUNET_CONTAINER_MultiHashMap
                                        *map)
 {
-  unsigned int i;
-  union MapEntry me;
-
-  for (i = 0; i < map->map_length; i++)
+  if (0 != map->iterating)
   {
-    me = map->map[i];
-    if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-	nxt = sme->next;
-	GNUNET_free (sme);
-      }
-      me.sme = NULL;
-    }
-    else
-    {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-	nxt = bme->next;
-	GNUNET_free (bme);
-      }
-      me.bme = NULL;
-    }
+    /* destroyed from within an iterator callback */
+    map->destroy_pending = GNUNET_YES;
+    return;
   }
-  GNUNET_free (map->map);
+  if (map->use_small_entries)
+    GNUNET_free (map->map.sme);
+  else
+    GNUNET_free (map->map.bme);
+  GNUNET_free (map->info);
   GNUNET_free (map);
 }
 
 
 /**
- * Compute the index of the bucket for the given key.
+ * Compute the 32-bit hash of the given key.
+ *
+ * @param key key to hash
+ * @return the first 32 bits of @a key
+ */
+static uint32_t
+hash_of (const struct GNUNET_HashCode *key)
+{
+  return key->bits[0];
+}
+
+
+/**
+ * Compute the index of the home slot for the given hash.
  *
  * @param map hash map for which to compute the index
- * @param key what key should the index be computed for
+ * @param hash hash of the key, from hash_of()
  * @return offset into the "map" array of "map"
  */
 static unsigned int
 idx_of (const struct GNUNET_CONTAINER_MultiHashMap *map,
-        const struct GNUNET_HashCode *key)
+        uint32_t hash)
 {
-  GNUNET_assert (map != NULL);
-  return (*(unsigned int *) key) % map->map_length;
+  /* mix the bits, as we only use the low bits for the index */
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3bU;
+  hash ^= hash >> 16;
+  return hash & (map->map_length - 1);
+}
+
+
+/**
+ * Get the key of the entry in the given slot.
+ *
+ * @param map the map
+ * @param i slot index
+ * @return key of the entry
+ */
+static const struct GNUNET_HashCode *
+key_at (const struct GNUNET_CONTAINER_MultiHashMap *map,
+        unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->map.sme[i].key;
+  return &map->map.bme[i].key;
+}
+
+
+/**
+ * Get the value of the entry in the given slot.
+ *
+ * @param map the map
+ * @param i slot index
+ * @return value of the entry
+ */
+static void *
+value_at (const struct GNUNET_CONTAINER_MultiHashMap *map,
+          unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->map.sme[i].value;
+  return map->map.bme[i].value;
+}
+
+
+/**
+ * Check if the given slot holds a (not deleted) entry for @a key.
+ *
+ * @param map the map
+ * @param i slot index
+ * @param hash hash of @a key, from hash_of()
+ * @param key key to check for
+ * @return #GNUNET_YES if the slot holds an entry for @a key
+ */
+static int
+slot_matches (const struct GNUNET_CONTAINER_MultiHashMap *map,
+              unsigned int i,
+              uint32_t hash,
+              const struct GNUNET_HashCode *key)
+{
+  if ( (map->info[i].hash != hash) ||
+       (0 != (map->info[i].dist & SLOT_DELETED)) )
+    return GNUNET_NO;
+  return (0 == memcmp (key,
+                       key_at (map, i),
+                       sizeof (struct GNUNET_HashCode))) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Find the first slot holding an entry for a key, starting at
+ * slot @a i which is @a dist slots (plus one) from the home slot.
+ * Use with idx_of() and dist 1 to find the first match, and with
+ * the previous match plus one to find the next.
+ *
+ * @param map the map
+ * @param hash hash of @a key, from hash_of()
+ * @param key key to look for
+ * @param i slot to start at
+ * @param dist distance of @a i from the home slot, plus one
+ * @param[out] dist_ret set to the distance of the match, plus one
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_from (const struct GNUNET_CONTAINER_MultiHashMap *map,
+           uint32_t hash,
+           const struct GNUNET_HashCode *key,
+           unsigned int i,
+           uint32_t dist,
+           uint32_t *dist_ret)
+{
+  unsigned int mask = map->map_length - 1;
+
+  while (dist <= map->map_length)
+  {
+    /* Robin Hood invariant: our key cannot be further away than an
+       entry that is closer to its own home slot */
+    if ((map->info[i].dist & ~SLOT_DELETED) < dist)
+      break;
+    if (GNUNET_YES == slot_matches (map, i, hash, key))
+    {
+      *dist_ret = dist;
+      return i;
+    }
+    i = (i + 1) & mask;
+    dist++;
+  }
+  return map->map_length;
+}
+
+
+/**
+ * Find the first slot holding an entry for @a key.
+ *
+ * @param map the map
+ * @param key key to look for
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_first (const struct GNUNET_CONTAINER_MultiHashMap *map,
+            const struct GNUNET_HashCode *key)
+{
+  uint32_t hash = hash_of (key);
+  uint32_t dist;
+
+  return find_from (map, hash, key, idx_of (map, hash), 1, &dist);
 }
 
 
@@ -278,26 +482,118 @@ void *
 GNUNET_CONTAINER_multihashmap_get (const struct GNUNET_CONTAINER_MultiHashMap *map,
                                    const struct GNUNET_HashCode *key)
 {
-  union MapEntry me;
+  unsigned int i;
+
+  i = find_first (map, key);
+  if (i == map->map_length)
+    return NULL;
+  return value_at (map, i);
+}
 
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
-  {
-    struct SmallMapEntry *sme;
 
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode)))
-	return sme->value;
+/**
+ * Remove the entry in slot @a i by shifting the following entries
+ * of the cluster back towards their home slots.
+ *
+ * @param map the map
+ * @param i slot to clear
+ */
+static void
+shift_back (struct GNUNET_CONTAINER_MultiHashMap *map,
+            unsigned int i)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int j;
+
+  while (1)
+  {
+    j = (i + 1) & mask;
+    /* stop at empty slots and at entries in their home slot */
+    if ((map->info[j].dist & ~SLOT_DELETED) <= 1)
+      break;
+    map->info[i] = map->info[j];
+    map->info[i].dist--;
+    if (map->use_small_entries)
+      map->map.sme[i] = map->map.sme[j];
+    else
+      map->map.bme[i] = map->map.bme[j];
+    i = j;
   }
-  else
+  map->info[i].dist = 0;
+}
+
+
+/**
+ * Remove the entry in slot @a i.  If the map is being iterated over,
+ * the slot is only marked as deleted.
+ *
+ * @param map the map
+ * @param i slot of the entry
+ */
+static void
+remove_at (struct GNUNET_CONTAINER_MultiHashMap *map,
+           unsigned int i)
+{
+  map->size--;
+  if (0 != map->iterating)
   {
-    struct BigMapEntry *bme;
+    map->info[i].dist |= SLOT_DELETED;
+    map->deleted++;
+    return;
+  }
+  shift_back (map, i);
+}
+
 
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode)))
-	return bme->value;
+/**
+ * Start an iteration over @a map, during which removed slots
+ * are not compacted.
+ *
+ * @param map the map
+ */
+static void
+iteration_start (const struct GNUNET_CONTAINER_MultiHashMap *map)
+{
+  ((struct GNUNET_CONTAINER_MultiHashMap *) map)->iterating++;
+}
+
+
+/**
+ * Finish an iteration over @a map.  Compacts the slots removed
+ * during the iteration (or frees the map if it was destroyed)
+ * once no iteration is running anymore.
+ *
+ * @param cmap the map
+ */
+static void
+iteration_done (const struct GNUNET_CONTAINER_MultiHashMap *cmap)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *map;
+  unsigned int i;
+
+  map = (struct GNUNET_CONTAINER_MultiHashMap *) cmap;
+  GNUNET_assert (map->iterating > 0);
+  map->iterating--;
+  if (0 != map->iterating)
+    return;
+  if (GNUNET_YES == map->destroy_pending)
+  {
+    GNUNET_CONTAINER_multihashmap_destroy (map);
+    return;
   }
-  return NULL;
+  if (0 == map->deleted)
+    return;
+  /* shifting only moves entries to lower slots (or from the
+     start of the array to its end), so one pass suffices */
+  i = 0;
+  while (i < map->map_length)
+  {
+    if (0 != (map->info[i].dist & SLOT_DELETED))
+      shift_back (map, i);
+    else
+      i++;
+  }
+  map->deleted = 0;
 }
 
 
@@ -318,50 +614,37 @@ GNUNET_CONTAINER_multihashmap_iterate (const struct
 {
   int count;
   unsigned int i;
-  union MapEntry me;
   struct GNUNET_HashCode kc;
+  const struct GNUNET_HashCode *key;
 
-  count = 0;
   GNUNET_assert (NULL != map);
-  for (i = 0; i < map->map_length; i++)
+  if (NULL == it)
+    return map->size;
+  count = 0;
+  iteration_start (map);
+  /* the map may grow while we iterate, so always re-check the length */
+  for (i = 0; (i < map->map_length) && (GNUNET_NO == map->destroy_pending); i++)
   {
-    me = map->map[i];
+    if ( (0 == map->info[i].dist) ||
+         (0 != (map->info[i].dist & SLOT_DELETED)) )
+      continue;
     if (map->use_small_entries)
     {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-	nxt = sme->next;
-	if (NULL != it)
-	{
-	  if (GNUNET_OK != it (it_cls, sme->key, sme->value))
-	    return GNUNET_SYSERR;
-	}
-	count++;
-      }
+      key = map->map.sme[i].key;
     }
     else
     {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-	nxt = bme->next;
-	if (NULL != it)
-	{
-	  kc = bme->key;
-	  if (GNUNET_OK != it (it_cls, &kc, bme->value))
-	    return GNUNET_SYSERR;
-	}
-	count++;
-      }
+      kc = map->map.bme[i].key;
+      key = &kc;
     }
+    if (GNUNET_OK != it (it_cls, key, value_at (map, i)))
+    {
+      iteration_done (map);
+      return GNUNET_SYSERR;
+    }
+    count++;
   }
+  iteration_done (map);
   return count;
 }
 
@@ -382,56 +665,24 @@ GNUNET_CONTAINER_multihashmap_remove (struct GNUNET_CONTAINER_MultiHashMap *map,
                                       const struct GNUNET_HashCode *key,
 				      const void *value)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
   unsigned int i;
 
   map->modification_counter++;
 
-  i = idx_of (map, key);
-  me = map->map[i];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *p;
-
-    p = NULL;
-    for (sme = me.sme; NULL != sme; sme = sme->next)
+    if (value == value_at (map, i))
     {
-      if ((0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode))) &&
-	  (value == sme->value))
-      {
-	if (NULL == p)
-	  map->map[i].sme = sme->next;
-	else
-	  p->next = sme->next;
-	GNUNET_free (sme);
-	map->size--;
-	return GNUNET_YES;
-      }
-      p = sme;
-    }
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *p;
-
-    p = NULL;
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-    {
-      if ((0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode))) &&
-	  (value == bme->value))
-      {
-	if (NULL == p)
-	  map->map[i].bme = bme->next;
-	else
-	  p->next = bme->next;
-	GNUNET_free (bme);
-	map->size--;
-	return GNUNET_YES;
-      }
-      p = bme;
+      remove_at (map, i);
+      return GNUNET_YES;
     }
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
   return GNUNET_NO;
 }
@@ -449,101 +700,36 @@ int
 GNUNET_CONTAINER_multihashmap_remove_all (struct GNUNET_CONTAINER_MultiHashMap *map,
                                           const struct GNUNET_HashCode *key)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
   unsigned int i;
   int ret;
 
   map->modification_counter++;
 
   ret = 0;
-  i = idx_of (map, key);
-  me = map->map[i];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *p;
-
-    p = NULL;
-    sme = me.sme;
-    while (NULL != sme)
+    remove_at (map, i);
+    ret++;
+    if (0 == map->iterating)
     {
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode)))
-      {
-	if (NULL == p)
-	  map->map[i].sme = sme->next;
-	else
-	  p->next = sme->next;
-	GNUNET_free (sme);
-	map->size--;
-	if (NULL == p)
-	  sme = map->map[i].sme;
-	else
-	  sme = p->next;
-	ret++;
-      }
-      else
-      {
-	p = sme;
-	sme = sme->next;
-      }
+      /* the next entry of the cluster moved into slot i */
+      i = find_from (map, hash, key, i, dist, &dist);
     }
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *p;
-
-    p = NULL;
-    bme = me.bme;
-    while (NULL != bme)
+    else
     {
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode)))
-      {
-	if (NULL == p)
-	  map->map[i].bme = bme->next;
-	else
-	  p->next = bme->next;
-	GNUNET_free (bme);
-	map->size--;
-	if (NULL == p)
-	  bme = map->map[i].bme;
-	else
-	  bme = p->next;
-	ret++;
-      }
-      else
-      {
-	p = bme;
-	bme = bme->next;
-      }
+      i = find_from (map, hash, key,
+                     (i + 1) & (map->map_length - 1), dist + 1,
+                     &dist);
     }
   }
   return ret;
 }
 
 
-/**
- * Callback used to remove all entries from the map.
- *
- * @param cls the `struct GNUNET_CONTAINER_MultiHashMap`
- * @param key the key
- * @param value the value
- * @return #GNUNET_OK (continue to iterate)
- */
-static int
-remove_all (void *cls,
-            const struct GNUNET_HashCode *key,
-            void *value)
-{
-  struct GNUNET_CONTAINER_MultiHashMap *map = cls;
-
-  GNUNET_CONTAINER_multihashmap_remove (map,
-                                        key,
-                                        value);
-  return GNUNET_OK;
-}
-
-
 /**
  * @ingroup hashmap
  * Remove all entries from the map.
@@ -556,11 +742,22 @@ unsigned int
 GNUNET_CONTAINER_multihashmap_clear (struct GNUNET_CONTAINER_MultiHashMap *map)
 {
   unsigned int ret;
+  unsigned int i;
 
+  map->modification_counter++;
   ret = map->size;
-  GNUNET_CONTAINER_multihashmap_iterate (map,
-                                         &remove_all,
-                                         map);
+  if (0 != map->iterating)
+  {
+    for (i = 0; i < map->map_length; i++)
+      if ( (0 != map->info[i].dist) &&
+           (0 == (map->info[i].dist & SLOT_DELETED)) )
+        remove_at (map, i);
+    return ret;
+  }
+  memset (map->info,
+          0,
+          map->map_length * sizeof (struct SlotInfo));
+  map->size = 0;
   return ret;
 }
 
@@ -579,26 +776,7 @@ GNUNET_CONTAINER_multihashmap_contains (const struct
                                         GNUNET_CONTAINER_MultiHashMap *map,
                                         const struct GNUNET_HashCode *key)
 {
-  union MapEntry me;
-
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
-  {
-    struct SmallMapEntry *sme;
-
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode)))
-	return GNUNET_YES;
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode)))
-	return GNUNET_YES;
-  }
-  return GNUNET_NO;
+  return (find_first (map, key) != map->map_length) ? GNUNET_YES : GNUNET_NO;
 }
 
 
@@ -618,82 +796,183 @@ GNUNET_CONTAINER_multihashmap_contains_value (const struct
                                               *map, const struct GNUNET_HashCode *key,
                                               const void *value)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
+  unsigned int i;
 
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if ( (0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode))) &&
-	   (sme->value == value) )
-	return GNUNET_YES;
+    if (value == value_at (map, i))
+      return GNUNET_YES;
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
-  else
-  {
-    struct BigMapEntry *bme;
+  return GNUNET_NO;
+}
 
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if ( (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode))) &&
-	   (bme->value == value) )
-	return GNUNET_YES;
+
+/**
+ * Insert an entry into the slot array, without checking for
+ * duplicates or growing the map.
+ *
+ * @param map the map
+ * @param hash hash of the key, from hash_of()
+ * @param ec the entry to insert
+ */
+static void
+insert (struct GNUNET_CONTAINER_MultiHashMap *map,
+        uint32_t hash,
+        const union EntryCopy *ec)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int i;
+  struct SlotInfo carry;
+  struct SlotInfo si;
+  union EntryCopy cur;
+  union EntryCopy tmp;
+
+  carry.hash = hash;
+  carry.dist = 1;
+  cur = *ec;
+  i = idx_of (map, hash);
+  while (1)
+  {
+    si = map->info[i];
+    if ( (0 == si.dist) ||
+         ( (0 != (si.dist & SLOT_DELETED)) &&
+           ((si.dist & ~SLOT_DELETED) <= carry.dist) ) )
+    {
+      /* free slot, or a deleted one we may take over */
+      if (0 != si.dist)
+        map->deleted--;
+      map->info[i] = carry;
+      if (map->use_small_entries)
+        map->map.sme[i] = cur.sme;
+      else
+        map->map.bme[i] = cur.bme;
+      return;
+    }
+    if ((si.dist & ~SLOT_DELETED) < carry.dist)
+    {
+      /* Robin Hood: take the slot from the entry closer to home */
+      map->info[i] = carry;
+      carry = si;
+      if (map->use_small_entries)
+      {
+        tmp.sme = map->map.sme[i];
+        map->map.sme[i] = cur.sme;
+      }
+      else
+      {
+        tmp.bme = map->map.bme[i];
+        map->map.bme[i] = cur.bme;
+      }
+      cur = tmp;
+    }
+    i = (i + 1) & mask;
+    carry.dist++;
   }
-  return GNUNET_NO;
 }
 
 
 /**
- * Grow the given map to a more appropriate size.
+ * Move all entries of the given map into a slot array of
+ * the given length.
  *
- * @param map the hash map to grow
+ * @param map the hash map to rehash
+ * @param new_len new number of slots, must be a power of two
  */
 static void
-grow (struct GNUNET_CONTAINER_MultiHashMap *map)
+rehash (struct GNUNET_CONTAINER_MultiHashMap *map,
+        unsigned int new_len)
 {
-  union MapEntry *old_map;
-  union MapEntry *new_map;
+  struct SlotInfo *old_info;
+  union MapEntry old_map;
+  union EntryCopy ec;
   unsigned int old_len;
-  unsigned int new_len;
-  unsigned int idx;
   unsigned int i;
 
   map->modification_counter++;
 
+  old_info = map->info;
   old_map = map->map;
   old_len = map->map_length;
-  new_len = old_len * 2;
-  new_map = GNUNET_malloc (sizeof (union MapEntry) * new_len);
-  map->map_length = new_len;
-  map->map = new_map;
+  alloc_slots (map, new_len);
+  /* deleted slots are dropped while rehashing */
+  map->deleted = 0;
   for (i = 0; i < old_len; i++)
   {
+    if ( (0 == old_info[i].dist) ||
+         (0 != (old_info[i].dist & SLOT_DELETED)) )
+      continue;
     if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-
-      while (NULL != (sme = old_map[i].sme))
-      {
-	old_map[i].sme = sme->next;
-	idx = idx_of (map, sme->key);
-	sme->next = new_map[idx].sme;
-	new_map[idx].sme = sme;
-      }
-    }
+      ec.sme = old_map.sme[i];
     else
-    {
-      struct BigMapEntry *bme;
-
-      while (NULL != (bme = old_map[i].bme))
-      {
-	old_map[i].bme = bme->next;
-	idx = idx_of (map, &bme->key);
-	bme->next = new_map[idx].bme;
-	new_map[idx].bme = bme;
-      }
-    }
+      ec.bme = old_map.bme[i];
+    insert (map, old_info[i].hash, &ec);
   }
-  GNUNET_free (old_map);
+  if (map->use_small_entries)
+    GNUNET_free (old_map.sme);
+  else
+    GNUNET_free (old_map.bme);
+  GNUNET_free (old_info);
+}
+
+
+/**
+ * Grow the given map to a more appropriate size.
+ *
+ * @param map the hash map to grow
+ */
+static void
+grow (struct GNUNET_CONTAINER_MultiHashMap *map)
+{
+  rehash (map, map->map_length * 2);
+}
+
+
+/**
+ * Check if the map needs more slots to hold @a count entries.
+ *
+ * @param map the map
+ * @param count number of entries the map must hold
+ * @return #GNUNET_YES if the map must grow first
+ */
+static int
+too_small (const struct GNUNET_CONTAINER_MultiHashMap *map,
+           unsigned int count)
+{
+  return ((uint64_t) count + map->deleted) * 8 >
+    (uint64_t) map->map_length * MAX_LOAD_EIGHTHS;
+}
+
+
+/**
+ * @ingroup hashmap
+ * Make sure the map can hold at least @a count entries in total
+ * without rehashing.  Useful before loading many entries at once.
+ *
+ * @param map the map
+ * @param count expected number of entries
+ */
+void
+GNUNET_CONTAINER_multihashmap_reserve (struct GNUNET_CONTAINER_MultiHashMap *map,
+                                       unsigned int count)
+{
+  unsigned int new_len;
+
+  if (count < map->size)
+    count = map->size;
+  if (GNUNET_NO == too_small (map, count))
+    return;
+  GNUNET_assert (count <= (1U << 30));
+  for (new_len = map->map_length;
+       ((uint64_t) count + map->deleted) * 8 > (uint64_t) new_len * MAX_LOAD_EIGHTHS;
+       new_len *= 2) ;
+  rehash (map, new_len);
 }
 
 
@@ -715,66 +994,37 @@ GNUNET_CONTAINER_multihashmap_put (struct GNUNET_CONTAINER_MultiHashMap *map,
 				   void *value,
                                    enum GNUNET_CONTAINER_MultiHashMapOption opt)
 {
-  union MapEntry me;
+  union EntryCopy ec;
   unsigned int i;
 
-  i = idx_of (map, key);
   if ((opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE) &&
       (opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
   {
-    me = map->map[i];
-    if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-
-      for (sme = me.sme; NULL != sme; sme = sme->next)
-	if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_HashCode)))
-	{
-	  if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
-	    return GNUNET_SYSERR;
-	  sme->value = value;
-	  return GNUNET_NO;
-	}
-    }
-    else
+    i = find_first (map, key);
+    if (i != map->map_length)
     {
-      struct BigMapEntry *bme;
-
-      for (bme = me.bme; NULL != bme; bme = bme->next)
-	if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode)))
-	{
-	  if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
-	    return GNUNET_SYSERR;
-	  bme->value = value;
-	  return GNUNET_NO;
-	}
+      if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
+        return GNUNET_SYSERR;
+      if (map->use_small_entries)
+        map->map.sme[i].value = value;
+      else
+        map->map.bme[i].value = value;
+      return GNUNET_NO;
     }
   }
-  if (map->size / 3 >= map->map_length / 4)
-  {
+  if (GNUNET_YES == too_small (map, map->size + 1))
     grow (map);
-    i = idx_of (map, key);
-  }
   if (map->use_small_entries)
   {
-    struct SmallMapEntry *sme;
-
-    sme = GNUNET_new (struct SmallMapEntry);
-    sme->key = key;
-    sme->value = value;
-    sme->next = map->map[i].sme;
-    map->map[i].sme = sme;
+    ec.sme.key = key;
+    ec.sme.value = value;
   }
   else
   {
-    struct BigMapEntry *bme;
-
-    bme = GNUNET_new (struct BigMapEntry);
-    bme->key = *key;
-    bme->value = value;
-    bme->next = map->map[i].bme;
-    map->map[i].bme = bme;
+    ec.bme.key = *key;
+    ec.bme.value = value;
   }
+  insert (map, hash_of (key), &ec);
   map->size++;
   return GNUNET_OK;
 }
@@ -798,43 +1048,135 @@ GNUNET_CONTAINER_multihashmap_get_multiple (const struct
                                             void *it_cls)
 {
   int count;
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
+  unsigned int i;
 
   count = 0;
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  iteration_start (map);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while ( (i != map->map_length) &&
+          (GNUNET_NO == map->destroy_pending) )
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *nxt;
-
-    nxt = me.sme;
-    while (NULL != (sme = nxt))
+    if ((it != NULL) && (GNUNET_OK != it (it_cls, key, value_at (map, i))))
     {
-      nxt = sme->next;
-      if (0 != memcmp (key, sme->key, sizeof (struct GNUNET_HashCode)))
-	continue;
-      if ((it != NULL) && (GNUNET_OK != it (it_cls, key, sme->value)))
-	return GNUNET_SYSERR;
-      count++;
+      iteration_done (map);
+      return GNUNET_SYSERR;
     }
+    count++;
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
+  iteration_done (map);
+  return count;
+}
+
+
+/**
+ * Prefetch the slot of the given key into the cache.
+ *
+ * @param map the map
+ * @param key key that we will look up soon
+ */
+static void
+prefetch_slot (const struct GNUNET_CONTAINER_MultiHashMap *map,
+               const struct GNUNET_HashCode *key)
+{
+#if defined(__GNUC__)
+  unsigned int i = idx_of (map, hash_of (key));
+
+  __builtin_prefetch (&map->info[i]);
+  if (map->use_small_entries)
+    __builtin_prefetch (&map->map.sme[i]);
   else
+    __builtin_prefetch (&map->map.bme[i]);
+#endif
+}
+
+
+/**
+ * @ingroup hashmap
+ * Store many key-value pairs in the map.  The map is grown once
+ * for all of them, and slots are prefetched ahead of the inserts.
+ * For maps created with @e do_not_copy_keys, the @a keys array must
+ * remain valid as long as the entries are in the map.
+ *
+ * @param map the map
+ * @param keys array of @a count keys
+ * @param values array of @a count values
+ * @param count number of pairs to store
+ * @param opt options for put, applied to each pair
+ * @return number of pairs that were added to the map (pairs that
+ *         replaced a value or were rejected by UNIQUE_ONLY are not
+ *         counted)
+ */
+unsigned int
+GNUNET_CONTAINER_multihashmap_put_multiple (struct GNUNET_CONTAINER_MultiHashMap *map,
+                                            const struct GNUNET_HashCode *keys,
+                                            void *const *values,
+                                            unsigned int count,
+                                            enum GNUNET_CONTAINER_MultiHashMapOption opt)
+{
+  unsigned int added;
+  unsigned int i;
+
+  GNUNET_CONTAINER_multihashmap_reserve (map,
+                                         map->size + count);
+  added = 0;
+  for (i = 0; i < count; i++)
   {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *nxt;
+    if (i + PREFETCH_DISTANCE < count)
+      prefetch_slot (map, &keys[i + PREFETCH_DISTANCE]);
+    if (GNUNET_OK ==
+        GNUNET_CONTAINER_multihashmap_put (map,
+                                           &keys[i],
+                                           values[i],
+                                           opt))
+      added++;
+  }
+  return added;
+}
+
+
+/**
+ * @ingroup hashmap
+ * Look up many keys in the map at once, prefetching slots ahead
+ * of the lookups.
+ *
+ * @param map the map
+ * @param keys array of @a count keys to look up
+ * @param[out] values array of @a count values, set to the (first)
+ *             value for each key, or NULL if the key is not in the map
+ * @param count number of keys
+ * @return number of keys that were found
+ */
+unsigned int
+GNUNET_CONTAINER_multihashmap_get_many (const struct GNUNET_CONTAINER_MultiHashMap *map,
+                                        const struct GNUNET_HashCode *keys,
+                                        void **values,
+                                        unsigned int count)
+{
+  unsigned int found;
+  unsigned int i;
+  unsigned int j;
 
-    nxt = me.bme;
-    while (NULL != (bme = nxt))
+  found = 0;
+  for (i = 0; i < count; i++)
+  {
+    if (i + PREFETCH_DISTANCE < count)
+      prefetch_slot (map, &keys[i + PREFETCH_DISTANCE]);
+    j = find_first (map, &keys[i]);
+    if (j == map->map_length)
     {
-      nxt = bme->next;
-      if (0 != memcmp (key, &bme->key, sizeof (struct GNUNET_HashCode)))
-	continue;
-      if ((it != NULL) && (GNUNET_OK != it (it_cls, key, bme->value)))
-	return GNUNET_SYSERR;
-      count++;
+      values[i] = NULL;
+      continue;
     }
+    values[i] = value_at (map, j);
+    found++;
   }
-  return count;
+  return found;
 }
 
 
@@ -856,7 +1198,6 @@ GNUNET_CONTAINER_multihashmap_get_random (const struct GNUNET_CONTAINER_MultiHas
 {
   unsigned int off;
   unsigned int idx;
-  union MapEntry me;
 
   if (0 == map->size)
     return 0;
@@ -866,46 +1207,18 @@ GNUNET_CONTAINER_multihashmap_get_random (const struct GNUNET_CONTAINER_MultiHas
                                   map->size);
   for (idx = 0; idx < map->map_length; idx++)
   {
-    me = map->map[idx];
-    if (map->use_small_entries)
+    if ( (0 == map->info[idx].dist) ||
+         (0 != (map->info[idx].dist & SLOT_DELETED)) )
+      continue;
+    if (0 == off)
     {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-        nxt = sme->next;
-        if (0 == off)
-        {
-          if (GNUNET_OK != it (it_cls,
-                               sme->key,
-                               sme->value))
-            return GNUNET_SYSERR;
-          return 1;
-        }
-        off--;
-      }
-    }
-    else
-    {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-        nxt = bme->next;
-        if (0 == off)
-        {
-          if (GNUNET_OK != it (it_cls,
-                               &bme->key, bme->value))
-            return GNUNET_SYSERR;
-          return 1;
-        }
-        off--;
-      }
+      if (GNUNET_OK != it (it_cls,
+                           key_at (map, idx),
+                           value_at (map, idx)))
+        return GNUNET_SYSERR;
+      return 1;
     }
+    off--;
   }
   GNUNET_break (0);
   return GNUNET_SYSERR;
@@ -932,7 +1245,6 @@ GNUNET_CONTAINER_multihashmap_iterator_create (const struct GNUNET_CONTAINER_Mul
   iter = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMapIterator);
   iter->map = map;
   iter->modification_counter = map->modification_counter;
-  iter->me = map->map[0];
   return iter;
 }
 
@@ -956,42 +1268,25 @@ GNUNET_CONTAINER_multihashmap_iterator_next (struct GNUNET_CONTAINER_MultiHashMa
                                              struct GNUNET_HashCode *key,
                                              const void **value)
 {
+  const struct GNUNET_CONTAINER_MultiHashMap *map = iter->map;
+
   /* make sure the map has not been modified */
-  GNUNET_assert (iter->modification_counter == iter->map->modification_counter);
+  GNUNET_assert (iter->modification_counter == map->modification_counter);
 
-  /* look for the next entry, skipping empty buckets */
-  while (1)
+  /* look for the next entry, skipping empty slots */
+  for (; iter->idx < map->map_length; iter->idx++)
   {
-    if (iter->idx >= iter->map->map_length)
-      return GNUNET_NO;
-    if (GNUNET_YES == iter->map->use_small_entries)
-    {
-      if (NULL != iter->me.sme)
-      {
-        if (NULL != key)
-          *key = *iter->me.sme->key;
-        if (NULL != value)
-          *value = iter->me.sme->value;
-        iter->me.sme = iter->me.sme->next;
-        return GNUNET_YES;
-      }
-    }
-    else
-    {
-      if (NULL != iter->me.bme)
-      {
-        if (NULL != key)
-          *key = iter->me.bme->key;
-        if (NULL != value)
-          *value = iter->me.bme->value;
-        iter->me.bme = iter->me.bme->next;
-        return GNUNET_YES;
-      }
-    }
-    iter->idx += 1;
-    if (iter->idx < iter->map->map_length)
-      iter->me = iter->map->map[iter->idx];
+    if ( (0 == map->info[iter->idx].dist) ||
+         (0 != (map->info[iter->idx].dist & SLOT_DELETED)) )
+      continue;
+    if (NULL != key)
+      *key = *key_at (map, iter->idx);
+    if (NULL != value)
+      *value = value_at (map, iter->idx);
+    iter->idx++;
+    return GNUNET_YES;
   }
+  return GNUNET_NO;
 }
 
 
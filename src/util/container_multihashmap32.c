@@ -1,6 +1,6 @@
 /*
      This file is part of GNUnet.
-     Copyright (C) 2008 Christian Grothoff (and other contributing authors)
+     Copyright (C) 2008, 2015 Christian Grothoff (and other contributing authors)
 
      GNUnet is free software; you can redistribute it and/or modify
      it under the terms of the GNU General Public License as published
@@ -23,6 +23,11 @@
  *          uint32_t as keys
  * @author Christian Grothoff
  * @author Sree Harsha Totakura
+ *
+ * Like container_multihashmap.c, this uses open addressing with
+ * Robin Hood hashing and backward-shift deletion.  As the keys are
+ * small, they are kept in the `struct SlotInfo` array that is scanned
+ * during lookups, and only the values are stored separately.
  */
 
 #include "platform.h"
@@ -31,9 +36,22 @@
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
 /**
- * An entry in the hash map.
+ * Flag set in `struct SlotInfo` for slots whose entry was removed
+ * while the map was being iterated over.
+ */
+#define SLOT_DELETED 0x80000000U
+
+/**
+ * Grow the map once more than this many eighths of the slots
+ * are in use.
  */
-struct MapEntry
+#define MAX_LOAD_EIGHTHS 7
+
+
+/**
+ * Per-slot information.
+ */
+struct SlotInfo
 {
 
   /**
@@ -42,17 +60,15 @@ struct MapEntry
   uint32_t key;
 
   /**
-   * Value of the entry.
-   */
-  void *value;
-
-  /**
-   * If there is a hash collision, we create a linked list.
+   * 0 if the slot is empty, otherwise one plus the distance of the
+   * slot from the home slot of its key (possibly with
+   * #SLOT_DELETED set).
    */
-  struct MapEntry *next;
+  uint32_t dist;
 
 };
 
+
 /**
  * Internal representation of the hash map.
  */
@@ -60,9 +76,14 @@ struct GNUNET_CONTAINER_MultiHashMap32
 {
 
   /**
-   * All of our buckets.
+   * Information about each of our slots.
    */
-  struct MapEntry **map;
+  struct SlotInfo *info;
+
+  /**
+   * Values of the entries in each of our slots.
+   */
+  void **values;
 
   /**
    * Number of entries in the map.
@@ -70,10 +91,26 @@ struct GNUNET_CONTAINER_MultiHashMap32
   unsigned int size;
 
   /**
-   * Length of the "map" array.
+   * Length of the "info" and "values" arrays, always a power of two.
    */
   unsigned int map_length;
 
+  /**
+   * Number of slots marked with #SLOT_DELETED.
+   */
+  unsigned int deleted;
+
+  /**
+   * Number of iterations over the map currently running.
+   */
+  unsigned int iterating;
+
+  /**
+   * #GNUNET_YES if the map was destroyed while being iterated over,
+   * it is then freed once the iteration finishes.
+   */
+  int destroy_pending;
+
   /**
    * Counts the destructive modifications (grow, remove)
    * to the map, so that iterators can check if they are still valid.
@@ -89,12 +126,7 @@ struct GNUNET_CONTAINER_MultiHashMap32
 struct GNUNET_CONTAINER_MultiHashMap32Iterator
 {
   /**
-   * Position in the bucket 'idx'
-   */
-  struct MapEntry *me;
-
-  /**
-   * Current bucket index.
+   * Current slot index.
    */
   unsigned int idx;
 
@@ -111,6 +143,22 @@ struct GNUNET_CONTAINER_MultiHashMap32Iterator
 };
 
 
+/**
+ * Allocate the slot arrays of @a map for @a len slots.
+ *
+ * @param map the map
+ * @param len number of slots, must be a power of two
+ */
+static void
+alloc_slots (struct GNUNET_CONTAINER_MultiHashMap32 *map,
+             unsigned int len)
+{
+  map->map_length = len;
+  map->info = GNUNET_malloc (len * sizeof (struct SlotInfo));
+  map->values = GNUNET_malloc (len * sizeof (void *));
+}
+
+
 /**
  * Create a multi hash map.
  *
@@ -121,11 +169,13 @@ struct GNUNET_CONTAINER_MultiHashMap32 *
 GNUNET_CONTAINER_multihashmap32_create (unsigned int len)
 {
   struct GNUNET_CONTAINER_MultiHashMap32 *ret;
+  unsigned int slots;
 
   GNUNET_assert (len > 0);
+  GNUNET_assert (len <= (1U << 30));
+  for (slots = 4; slots < len; slots *= 2) ;
   ret = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMap32);
-  ret->map = GNUNET_malloc (len * sizeof (struct MapEntry *));
-  ret->map_length = len;
+  alloc_slots (ret, slots);
   return ret;
 }
 
@@ -140,35 +190,92 @@ void
 GNUNET_CONTAINER_multihashmap32_destroy (struct GNUNET_CONTAINER_MultiHashMap32
                                          *map)
 {
-  unsigned int i;
-  struct MapEntry *e;
-
-  for (i = 0; i < map->map_length; i++)
+  if (0 != map->iterating)
   {
-    while (NULL != (e = map->map[i]))
-    {
-      map->map[i] = e->next;
-      GNUNET_free (e);
-    }
+    /* destroyed from within an iterator callback */
+    map->destroy_pending = GNUNET_YES;
+    return;
   }
-  GNUNET_free (map->map);
+  GNUNET_free (map->values);
+  GNUNET_free (map->info);
   GNUNET_free (map);
 }
 
 
 /**
- * Compute the index of the bucket for the given key.
+ * Compute the index of the home slot for the given key.
  *
  * @param m hash map for which to compute the index
  * @param key what key should the index be computed for
- * @return offset into the "map" array of "m"
+ * @return offset into the "info" array of "m"
  */
 static unsigned int
 idx_of (const struct GNUNET_CONTAINER_MultiHashMap32 *m,
-        const uint32_t key)
+        uint32_t key)
+{
+  /* mix the bits, as we only use the low bits for the index */
+  key ^= key >> 16;
+  key *= 0x45d9f3bU;
+  key ^= key >> 16;
+  return key & (m->map_length - 1);
+}
+
+
+/**
+ * Find the first slot holding an entry for @a key, starting at
+ * slot @a i which is @a dist slots (plus one) from the home slot.
+ * Use with idx_of() and dist 1 to find the first match, and with
+ * the previous match plus one to find the next.
+ *
+ * @param map the map
+ * @param key key to look for
+ * @param i slot to start at
+ * @param dist distance of @a i from the home slot, plus one
+ * @param[out] dist_ret set to the distance of the match, plus one
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_from (const struct GNUNET_CONTAINER_MultiHashMap32 *map,
+           uint32_t key,
+           unsigned int i,
+           uint32_t dist,
+           uint32_t *dist_ret)
 {
-  GNUNET_assert (m != NULL);
-  return ((unsigned int) key) % m->map_length;
+  unsigned int mask = map->map_length - 1;
+
+  while (dist <= map->map_length)
+  {
+    /* Robin Hood invariant: our key cannot be further away than an
+       entry that is closer to its own home slot */
+    if ((map->info[i].dist & ~SLOT_DELETED) < dist)
+      break;
+    if ( (map->info[i].key == key) &&
+         (0 == (map->info[i].dist & SLOT_DELETED)) )
+    {
+      *dist_ret = dist;
+      return i;
+    }
+    i = (i + 1) & mask;
+    dist++;
+  }
+  return map->map_length;
+}
+
+
+/**
+ * Find the first slot holding an entry for @a key.
+ *
+ * @param map the map
+ * @param key key to look for
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_first (const struct GNUNET_CONTAINER_MultiHashMap32 *map,
+            uint32_t key)
+{
+  uint32_t dist;
+
+  return find_from (map, key, idx_of (map, key), 1, &dist);
 }
 
 
@@ -201,16 +308,115 @@ GNUNET_CONTAINER_multihashmap32_get (const struct
                                      GNUNET_CONTAINER_MultiHashMap32 *map,
                                      uint32_t key)
 {
-  struct MapEntry *e;
+  unsigned int i;
+
+  i = find_first (map, key);
+  if (i == map->map_length)
+    return NULL;
+  return map->values[i];
+}
+
+
+/**
+ * Remove the entry in slot @a i by shifting the following entries
+ * of the cluster back towards their home slots.
+ *
+ * @param map the map
+ * @param i slot to clear
+ */
+static void
+shift_back (struct GNUNET_CONTAINER_MultiHashMap32 *map,
+            unsigned int i)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int j;
 
-  e = map->map[idx_of (map, key)];
-  while (e != NULL)
+  while (1)
   {
-    if (key == e->key)
-      return e->value;
-    e = e->next;
+    j = (i + 1) & mask;
+    /* stop at empty slots and at entries in their home slot */
+    if ((map->info[j].dist & ~SLOT_DELETED) <= 1)
+      break;
+    map->info[i] = map->info[j];
+    map->info[i].dist--;
+    map->values[i] = map->values[j];
+    i = j;
   }
-  return NULL;
+  map->info[i].dist = 0;
+}
+
+
+/**
+ * Remove the entry in slot @a i.  If the map is being iterated over,
+ * the slot is only marked as deleted.
+ *
+ * @param map the map
+ * @param i slot of the entry
+ */
+static void
+remove_at (struct GNUNET_CONTAINER_MultiHashMap32 *map,
+           unsigned int i)
+{
+  map->size--;
+  if (0 != map->iterating)
+  {
+    map->info[i].dist |= SLOT_DELETED;
+    map->deleted++;
+    return;
+  }
+  shift_back (map, i);
+}
+
+
+/**
+ * Start an iteration over @a map, during which removed slots
+ * are not compacted.
+ *
+ * @param map the map
+ */
+static void
+iteration_start (const struct GNUNET_CONTAINER_MultiHashMap32 *map)
+{
+  ((struct GNUNET_CONTAINER_MultiHashMap32 *) map)->iterating++;
+}
+
+
+/**
+ * Finish an iteration over @a map.  Compacts the slots removed
+ * during the iteration (or frees the map if it was destroyed)
+ * once no iteration is running anymore.
+ *
+ * @param cmap the map
+ */
+static void
+iteration_done (const struct GNUNET_CONTAINER_MultiHashMap32 *cmap)
+{
+  struct GNUNET_CONTAINER_MultiHashMap32 *map;
+  unsigned int i;
+
+  map = (struct GNUNET_CONTAINER_MultiHashMap32 *) cmap;
+  GNUNET_assert (map->iterating > 0);
+  map->iterating--;
+  if (0 != map->iterating)
+    return;
+  if (GNUNET_YES == map->destroy_pending)
+  {
+    GNUNET_CONTAINER_multihashmap32_destroy (map);
+    return;
+  }
+  if (0 == map->deleted)
+    return;
+  /* shifting only moves entries to lower slots (or from the
+     start of the array to its end), so one pass suffices */
+  i = 0;
+  while (i < map->map_length)
+  {
+    if (0 != (map->info[i].dist & SLOT_DELETED))
+      shift_back (map, i);
+    else
+      i++;
+  }
+  map->deleted = 0;
 }
 
 
@@ -231,25 +437,26 @@ GNUNET_CONTAINER_multihashmap32_iterate (const struct
 {
   int count;
   unsigned int i;
-  struct MapEntry *e;
-  struct MapEntry *n;
 
-  count = 0;
   GNUNET_assert (NULL != map);
-  for (i = 0; i < map->map_length; i++)
+  if (NULL == it)
+    return map->size;
+  count = 0;
+  iteration_start (map);
+  /* the map may grow while we iterate, so always re-check the length */
+  for (i = 0; (i < map->map_length) && (GNUNET_NO == map->destroy_pending); i++)
   {
-    n = map->map[i];
-    while (NULL != (e = n))
+    if ( (0 == map->info[i].dist) ||
+         (0 != (map->info[i].dist & SLOT_DELETED)) )
+      continue;
+    if (GNUNET_OK != it (it_cls, map->info[i].key, map->values[i]))
     {
-      n = e->next;
-      if (NULL != it)
-      {
-        if (GNUNET_OK != it (it_cls, e->key, e->value))
-          return GNUNET_SYSERR;
-      }
-      count++;
+      iteration_done (map);
+      return GNUNET_SYSERR;
     }
+    count++;
   }
+  iteration_done (map);
   return count;
 }
 
@@ -270,29 +477,22 @@ GNUNET_CONTAINER_multihashmap32_remove (struct GNUNET_CONTAINER_MultiHashMap32
                                         *map,
                                         uint32_t key, const void *value)
 {
-  struct MapEntry *e;
-  struct MapEntry *p;
+  uint32_t dist;
   unsigned int i;
 
   map->modification_counter++;
 
-  i = idx_of (map, key);
-  p = NULL;
-  e = map->map[i];
-  while (e != NULL)
+  i = find_from (map, key, idx_of (map, key), 1, &dist);
+  while (i != map->map_length)
   {
-    if ( (key == e->key) && (value == e->value) )
+    if (value == map->values[i])
     {
-      if (p == NULL)
-        map->map[i] = e->next;
-      else
-        p->next = e->next;
-      GNUNET_free (e);
-      map->size--;
+      remove_at (map, i);
       return GNUNET_YES;
     }
-    p = e;
-    e = e->next;
+    i = find_from (map, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
   return GNUNET_NO;
 }
@@ -312,37 +512,28 @@ GNUNET_CONTAINER_multihashmap32_remove_all (struct
                                             *map,
                                             uint32_t key)
 {
-  struct MapEntry *e;
-  struct MapEntry *p;
+  uint32_t dist;
   unsigned int i;
   int ret;
 
   map->modification_counter++;
 
   ret = 0;
-  i = idx_of (map, key);
-  p = NULL;
-  e = map->map[i];
-  while (e != NULL)
+  i = find_from (map, key, idx_of (map, key), 1, &dist);
+  while (i != map->map_length)
   {
-    if (key == e->key)
+    remove_at (map, i);
+    ret++;
+    if (0 == map->iterating)
     {
-      if (p == NULL)
-        map->map[i] = e->next;
-      else
-        p->next = e->next;
-      GNUNET_free (e);
-      map->size--;
-      if (p == NULL)
-        e = map->map[i];
-      else
-        e = p->next;
-      ret++;
+      /* the next entry of the cluster moved into slot i */
+      i = find_from (map, key, i, dist, &dist);
     }
     else
     {
-      p = e;
-      e = e->next;
+      i = find_from (map, key,
+                     (i + 1) & (map->map_length - 1), dist + 1,
+                     &dist);
     }
   }
   return ret;
@@ -363,16 +554,7 @@ GNUNET_CONTAINER_multihashmap32_contains (const struct
                                           GNUNET_CONTAINER_MultiHashMap32 *map,
                                           uint32_t key)
 {
-  struct MapEntry *e;
-
-  e = map->map[idx_of (map, key)];
-  while (e != NULL)
-  {
-    if (key == e->key)
-      return GNUNET_YES;
-    e = e->next;
-  }
-  return GNUNET_NO;
+  return (find_first (map, key) != map->map_length) ? GNUNET_YES : GNUNET_NO;
 }
 
 
@@ -393,19 +575,73 @@ GNUNET_CONTAINER_multihashmap32_contains_value (const struct
                                                 uint32_t key,
                                                 const void *value)
 {
-  struct MapEntry *e;
+  uint32_t dist;
+  unsigned int i;
 
-  e = map->map[idx_of (map, key)];
-  while (e != NULL)
+  i = find_from (map, key, idx_of (map, key), 1, &dist);
+  while (i != map->map_length)
   {
-    if ( (key == e->key) && (e->value == value) )
+    if (value == map->values[i])
       return GNUNET_YES;
-    e = e->next;
+    i = find_from (map, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
   return GNUNET_NO;
 }
 
 
+/**
+ * Insert an entry into the slot arrays, without checking for
+ * duplicates or growing the map.
+ *
+ * @param map the map
+ * @param key key of the entry
+ * @param value value of the entry
+ */
+static void
+insert (struct GNUNET_CONTAINER_MultiHashMap32 *map,
+        uint32_t key,
+        void *value)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int i;
+  struct SlotInfo carry;
+  struct SlotInfo si;
+  void *tmp;
+
+  carry.key = key;
+  carry.dist = 1;
+  i = idx_of (map, key);
+  while (1)
+  {
+    si = map->info[i];
+    if ( (0 == si.dist) ||
+         ( (0 != (si.dist & SLOT_DELETED)) &&
+           ((si.dist & ~SLOT_DELETED) <= carry.dist) ) )
+    {
+      /* free slot, or a deleted one we may take over */
+      if (0 != si.dist)
+        map->deleted--;
+      map->info[i] = carry;
+      map->values[i] = value;
+      return;
+    }
+    if ((si.dist & ~SLOT_DELETED) < carry.dist)
+    {
+      /* Robin Hood: take the slot from the entry closer to home */
+      map->info[i] = carry;
+      carry = si;
+      tmp = map->values[i];
+      map->values[i] = value;
+      value = tmp;
+    }
+    i = (i + 1) & mask;
+    carry.dist++;
+  }
+}
+
+
 /**
  * Grow the given map to a more appropriate size.
  *
@@ -414,33 +650,28 @@ GNUNET_CONTAINER_multihashmap32_contains_value (const struct
 static void
 grow (struct GNUNET_CONTAINER_MultiHashMap32 *map)
 {
-  struct MapEntry **old_map;
-  struct MapEntry **new_map;
-  struct MapEntry *e;
+  struct SlotInfo *old_info;
+  void **old_values;
   unsigned int old_len;
-  unsigned int new_len;
-  unsigned int idx;
   unsigned int i;
 
   map->modification_counter++;
 
-  old_map = map->map;
+  old_info = map->info;
+  old_values = map->values;
   old_len = map->map_length;
-  new_len = old_len * 2;
-  new_map = GNUNET_malloc (sizeof (struct MapEntry *) * new_len);
-  map->map_length = new_len;
-  map->map = new_map;
+  alloc_slots (map, old_len * 2);
+  /* deleted slots are dropped while rehashing */
+  map->deleted = 0;
   for (i = 0; i < old_len; i++)
   {
-    while (NULL != (e = old_map[i]))
-    {
-      old_map[i] = e->next;
-      idx = idx_of (map, e->key);
-      e->next = new_map[idx];
-      new_map[idx] = e;
-    }
+    if ( (0 == old_info[i].dist) ||
+         (0 != (old_info[i].dist & SLOT_DELETED)) )
+      continue;
+    insert (map, old_info[i].key, old_values[i]);
   }
-  GNUNET_free (old_map);
+  GNUNET_free (old_values);
+  GNUNET_free (old_info);
 }
 
 
@@ -462,36 +693,24 @@ GNUNET_CONTAINER_multihashmap32_put (struct GNUNET_CONTAINER_MultiHashMap32
                                      enum GNUNET_CONTAINER_MultiHashMapOption
                                      opt)
 {
-  struct MapEntry *e;
   unsigned int i;
 
-  i = idx_of (map, key);
   if ((opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE) &&
       (opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
   {
-    e = map->map[i];
-    while (e != NULL)
+    i = find_first (map, key);
+    if (i != map->map_length)
     {
-      if (key == e->key)
-      {
-        if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
-          return GNUNET_SYSERR;
-        e->value = value;
-        return GNUNET_NO;
-      }
-      e = e->next;
+      if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
+        return GNUNET_SYSERR;
+      map->values[i] = value;
+      return GNUNET_NO;
     }
   }
-  if (map->size / 3 >= map->map_length / 4)
-  {
+  if ((map->size + map->deleted + 1) * 8 >
+      map->map_length * MAX_LOAD_EIGHTHS)
     grow (map);
-    i = idx_of (map, key);
-  }
-  e = GNUNET_new (struct MapEntry);
-  e->key = key;
-  e->value = value;
-  e->next = map->map[i];
-  map->map[i] = e;
+  insert (map, key, value);
   map->size++;
   return GNUNET_OK;
 }
@@ -515,20 +734,26 @@ GNUNET_CONTAINER_multihashmap32_get_multiple (const struct
                                               it, void *it_cls)
 {
   int count;
-  struct MapEntry *e;
-  struct MapEntry *n;
+  uint32_t dist;
+  unsigned int i;
 
   count = 0;
-  n = map->map[idx_of (map, key)];
-  while (NULL != (e = n))
+  iteration_start (map);
+  i = find_from (map, key, idx_of (map, key), 1, &dist);
+  while ( (i != map->map_length) &&
+          (GNUNET_NO == map->destroy_pending) )
   {
-    n = e->next;
-    if (key != e->key)
-      continue;
-    if ((it != NULL) && (GNUNET_OK != it (it_cls, key, e->value)))
+    if ((it != NULL) && (GNUNET_OK != it (it_cls, key, map->values[i])))
+    {
+      iteration_done (map);
       return GNUNET_SYSERR;
+    }
     count++;
+    i = find_from (map, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
+  iteration_done (map);
   return count;
 }
 
@@ -553,7 +778,6 @@ GNUNET_CONTAINER_multihashmap32_iterator_create (const struct GNUNET_CONTAINER_M
   iter = GNUNET_new (struct GNUNET_CONTAINER_MultiHashMap32Iterator);
   iter->map = map;
   iter->modification_counter = map->modification_counter;
-  iter->me = map->map[0];
   return iter;
 }
 
@@ -577,27 +801,25 @@ GNUNET_CONTAINER_multihashmap32_iterator_next (struct GNUNET_CONTAINER_MultiHash
                                                uint32_t *key,
                                                const void **value)
 {
+  const struct GNUNET_CONTAINER_MultiHashMap32 *map = iter->map;
+
   /* make sure the map has not been modified */
-  GNUNET_assert (iter->modification_counter == iter->map->modification_counter);
+  GNUNET_assert (iter->modification_counter == map->modification_counter);
 
-  /* look for the next entry, skipping empty buckets */
-  while (1)
+  /* look for the next entry, skipping empty slots */
+  for (; iter->idx < map->map_length; iter->idx++)
   {
-    if (iter->idx >= iter->map->map_length)
-      return GNUNET_NO;
-    if (NULL != iter->me)
-    {
-      if (NULL != key)
-        *key = iter->me->key;
-      if (NULL != value)
-        *value = iter->me->value;
-      iter->me = iter->me->next;
-      return GNUNET_YES;
-    }
-    iter->idx += 1;
-    if (iter->idx < iter->map->map_length)
-      iter->me = iter->map->map[iter->idx];
+    if ( (0 == map->info[iter->idx].dist) ||
+         (0 != (map->info[iter->idx].dist & SLOT_DELETED)) )
+      continue;
+    if (NULL != key)
+      *key = map->info[iter->idx].key;
+    if (NULL != value)
+      *value = map->values[iter->idx];
+    iter->idx++;
+    return GNUNET_YES;
   }
+  return GNUNET_NO;
 }
 
 
@@ -1,6 +1,6 @@
 /*
      This file is part of GNUnet.
-     Copyright (C) 2008, 2012 Christian Grothoff (and other contributing authors)
+     Copyright (C) 2008, 2012, 2015 Christian Grothoff (and other contributing authors)
 
      GNUnet is free software; you can redistribute it and/or modify
      it under the terms of the GNU General Public License as published
@@ -21,6 +21,15 @@
  * @file util/container_multipeermap.c
  * @brief hash map where the same key may be present multiple times
  * @author Christian Grothoff
+ *
+ * The map uses open addressing with Robin Hood hashing: entries are
+ * stored directly in the slot array, and a compact array of
+ * `struct SlotInfo` (hash prefix and probe distance) is scanned
+ * during lookups, so that most probes never touch the entries.
+ * Removal uses backward shifting and thus leaves no tombstones.
+ * While an iteration is running, removed slots are only marked as
+ * deleted (so that the iteration neither skips nor repeats entries)
+ * and are compacted once the outermost iteration finishes.
  */
 
 #include "platform.h"
@@ -29,26 +38,56 @@
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
 /**
- * An entry in the hash map with the full key.
+ * Flag set in `struct SlotInfo` for slots whose entry was removed
+ * while the map was being iterated over.
  */
-struct BigMapEntry
+#define SLOT_DELETED 0x80000000U
+
+/**
+ * Grow the map once more than this many eighths of the slots
+ * are in use.
+ */
+#define MAX_LOAD_EIGHTHS 7
+
+
+/**
+ * Per-slot information, kept separate from the entries so that
+ * probing is cache-friendly.
+ */
+struct SlotInfo
 {
 
   /**
-   * Value of the entry.
+   * First 32 bits of the key of the entry in the slot.
    */
-  void *value;
+  uint32_t hash;
 
   /**
-   * If there is a hash collision, we create a linked list.
+   * 0 if the slot is empty, otherwise one plus the distance of the
+   * slot from the home slot of its key (possibly with
+   * #SLOT_DELETED set).
    */
-  struct BigMapEntry *next;
+  uint32_t dist;
+
+};
+
+
+/**
+ * An entry in the hash map with the full key.
+ */
+struct BigMapEntry
+{
 
   /**
    * Key for the entry.
    */
   struct GNUNET_PeerIdentity key;
 
+  /**
+   * Value of the entry.
+   */
+  void *value;
+
 };
 
 
@@ -63,11 +102,6 @@ struct SmallMapEntry
    */
   void *value;
 
-  /**
-   * If there is a hash collision, we create a linked list.
-   */
-  struct SmallMapEntry *next;
-
   /**
    * Key for the entry.
    */
@@ -77,7 +111,7 @@ struct SmallMapEntry
 
 
 /**
- * Entry in the map.
+ * Array of entries in the map.
  */
 union MapEntry
 {
@@ -93,15 +127,37 @@ union MapEntry
 };
 
 
+/**
+ * A single entry, used while moving entries around in the map.
+ */
+union EntryCopy
+{
+  /**
+   * Variant used if map entries only contain a pointer to the key.
+   */
+  struct SmallMapEntry sme;
+
+  /**
+   * Variant used if map entries contain the full key.
+   */
+  struct BigMapEntry bme;
+};
+
+
 /**
  * Internal representation of the hash map.
  */
 struct GNUNET_CONTAINER_MultiPeerMap
 {
   /**
-   * All of our buckets.
+   * All of our slots.
    */
-  union MapEntry *map;
+  union MapEntry map;
+
+  /**
+   * Information about each of our slots.
+   */
+  struct SlotInfo *info;
 
   /**
    * Number of entries in the map.
@@ -109,13 +165,29 @@ struct GNUNET_CONTAINER_MultiPeerMap
   unsigned int size;
 
   /**
-   * Length of the "map" array.
+   * Length of the "map" array, always a power of two.
    */
   unsigned int map_length;
 
   /**
-   * GNUNET_NO if the map entries are of type 'struct BigMapEntry',
-   * GNUNET_YES if the map entries are of type 'struct SmallMapEntry'.
+   * Number of slots marked with #SLOT_DELETED.
+   */
+  unsigned int deleted;
+
+  /**
+   * Number of iterations over the map currently running.
+   */
+  unsigned int iterating;
+
+  /**
+   * #GNUNET_YES if the map was destroyed while being iterated over,
+   * it is then freed once the iteration finishes.
+   */
+  int destroy_pending;
+
+  /**
+   * #GNUNET_NO if the map entries are of type 'struct BigMapEntry',
+   * #GNUNET_YES if the map entries are of type 'struct SmallMapEntry'.
    */
   int use_small_entries;
 
@@ -134,12 +206,7 @@ struct GNUNET_CONTAINER_MultiPeerMap
 struct GNUNET_CONTAINER_MultiPeerMapIterator
 {
   /**
-   * Position in the bucket 'idx'
-   */
-  union MapEntry me;
-
-  /**
-   * Current bucket index.
+   * Current slot index.
    */
   unsigned int idx;
 
@@ -156,12 +223,31 @@ struct GNUNET_CONTAINER_MultiPeerMapIterator
 };
 
 
+/**
+ * Allocate the slot arrays of @a map for @a len slots.
+ *
+ * @param map the map
+ * @param len number of slots, must be a power of two
+ */
+static void
+alloc_slots (struct GNUNET_CONTAINER_MultiPeerMap *map,
+             unsigned int len)
+{
+  map->map_length = len;
+  map->info = GNUNET_malloc (len * sizeof (struct SlotInfo));
+  if (map->use_small_entries)
+    map->map.sme = GNUNET_malloc (len * sizeof (struct SmallMapEntry));
+  else
+    map->map.bme = GNUNET_malloc (len * sizeof (struct BigMapEntry));
+}
+
+
 /**
  * Create a multi hash map.
  *
  * @param len initial size (map will grow as needed)
- * @param do_not_copy_keys GNUNET_NO is always safe and should be used by default;
- *                         GNUNET_YES means that on 'put', the 'key' does not have
+ * @param do_not_copy_keys #GNUNET_NO is always safe and should be used by default;
+ *                         #GNUNET_YES means that on 'put', the 'key' does not have
  *                         to be copied as the destination of the pointer is
  *                         guaranteed to be life as long as the value is stored in
  *                         the hashmap.  This can significantly reduce memory
@@ -176,12 +262,14 @@ GNUNET_CONTAINER_multipeermap_create (unsigned int len,
 				      int do_not_copy_keys)
 {
   struct GNUNET_CONTAINER_MultiPeerMap *map;
+  unsigned int slots;
 
   GNUNET_assert (len > 0);
+  GNUNET_assert (len <= (1U << 30));
+  for (slots = 4; slots < len; slots *= 2) ;
   map = GNUNET_new (struct GNUNET_CONTAINER_MultiPeerMap);
-  map->map = GNUNET_malloc (len * sizeof (union MapEntry));
-  map->map_length = len;
   map->use_small_entries = do_not_copy_keys;
+  alloc_slots (map, slots);
   return map;
 }
 
@@ -196,60 +284,171 @@ void
 GNUNET_CONTAINER_multipeermap_destroy (struct GNUNET_CONTAINER_MultiPeerMap
                                        *map)
 {
-  unsigned int i;
-  union MapEntry me;
-
-  for (i = 0; i < map->map_length; i++)
+  if (0 != map->iterating)
   {
-    me = map->map[i];
-    if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-	nxt = sme->next;
-	GNUNET_free (sme);
-      }
-      me.sme = NULL;
-    }
-    else
-    {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-	nxt = bme->next;
-	GNUNET_free (bme);
-      }
-      me.bme = NULL;
-    }
+    /* destroyed from within an iterator callback */
+    map->destroy_pending = GNUNET_YES;
+    return;
   }
-  GNUNET_free (map->map);
+  if (map->use_small_entries)
+    GNUNET_free (map->map.sme);
+  else
+    GNUNET_free (map->map.bme);
+  GNUNET_free (map->info);
   GNUNET_free (map);
 }
 
 
 /**
- * Compute the index of the bucket for the given key.
+ * Compute the 32-bit hash of the given key.
+ *
+ * @param key key to hash
+ * @return the first 32 bits of @a key
+ */
+static uint32_t
+hash_of (const struct GNUNET_PeerIdentity *key)
+{
+  uint32_t kx;
+
+  memcpy (&kx, key, sizeof (kx));
+  return kx;
+}
+
+
+/**
+ * Compute the index of the home slot for the given hash.
  *
  * @param map hash map for which to compute the index
- * @param key what key should the index be computed for
+ * @param hash hash of the key, from hash_of()
  * @return offset into the "map" array of "map"
  */
 static unsigned int
 idx_of (const struct GNUNET_CONTAINER_MultiPeerMap *map,
-        const struct GNUNET_PeerIdentity *key)
+        uint32_t hash)
 {
-  unsigned int kx;
+  /* mix the bits, as we only use the low bits for the index */
+  hash ^= hash >> 16;
+  hash *= 0x45d9f3bU;
+  hash ^= hash >> 16;
+  return hash & (map->map_length - 1);
+}
 
-  GNUNET_assert (NULL != map);
-  memcpy (&kx, key, sizeof (kx));
-  return kx % map->map_length;
+
+/**
+ * Get the key of the entry in the given slot.
+ *
+ * @param map the map
+ * @param i slot index
+ * @return key of the entry
+ */
+static const struct GNUNET_PeerIdentity *
+key_at (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+        unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->map.sme[i].key;
+  return &map->map.bme[i].key;
+}
+
+
+/**
+ * Get the value of the entry in the given slot.
+ *
+ * @param map the map
+ * @param i slot index
+ * @return value of the entry
+ */
+static void *
+value_at (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+          unsigned int i)
+{
+  if (map->use_small_entries)
+    return map->map.sme[i].value;
+  return map->map.bme[i].value;
+}
+
+
+/**
+ * Check if the given slot holds a (not deleted) entry for @a key.
+ *
+ * @param map the map
+ * @param i slot index
+ * @param hash hash of @a key, from hash_of()
+ * @param key key to check for
+ * @return #GNUNET_YES if the slot holds an entry for @a key
+ */
+static int
+slot_matches (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+              unsigned int i,
+              uint32_t hash,
+              const struct GNUNET_PeerIdentity *key)
+{
+  if ( (map->info[i].hash != hash) ||
+       (0 != (map->info[i].dist & SLOT_DELETED)) )
+    return GNUNET_NO;
+  return (0 == memcmp (key,
+                       key_at (map, i),
+                       sizeof (struct GNUNET_PeerIdentity))) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Find the first slot holding an entry for a key, starting at
+ * slot @a i which is @a dist slots (plus one) from the home slot.
+ * Use with idx_of() and dist 1 to find the first match, and with
+ * the previous match plus one to find the next.
+ *
+ * @param map the map
+ * @param hash hash of @a key, from hash_of()
+ * @param key key to look for
+ * @param i slot to start at
+ * @param dist distance of @a i from the home slot, plus one
+ * @param[out] dist_ret set to the distance of the match, plus one
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_from (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+           uint32_t hash,
+           const struct GNUNET_PeerIdentity *key,
+           unsigned int i,
+           uint32_t dist,
+           uint32_t *dist_ret)
+{
+  unsigned int mask = map->map_length - 1;
+
+  while (dist <= map->map_length)
+  {
+    /* Robin Hood invariant: our key cannot be further away than an
+       entry that is closer to its own home slot */
+    if ((map->info[i].dist & ~SLOT_DELETED) < dist)
+      break;
+    if (GNUNET_YES == slot_matches (map, i, hash, key))
+    {
+      *dist_ret = dist;
+      return i;
+    }
+    i = (i + 1) & mask;
+    dist++;
+  }
+  return map->map_length;
+}
+
+
+/**
+ * Find the first slot holding an entry for @a key.
+ *
+ * @param map the map
+ * @param key key to look for
+ * @return index of the slot, or @e map_length if there is none
+ */
+static unsigned int
+find_first (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+            const struct GNUNET_PeerIdentity *key)
+{
+  uint32_t hash = hash_of (key);
+  uint32_t dist;
+
+  return find_from (map, hash, key, idx_of (map, hash), 1, &dist);
 }
 
 
@@ -278,29 +477,121 @@ GNUNET_CONTAINER_multipeermap_size (const struct GNUNET_CONTAINER_MultiPeerMap
  *   key-value pairs with value NULL
  */
 void *
-GNUNET_CONTAINER_multipeermap_get (const struct GNUNET_CONTAINER_MultiPeerMap
-                                   *map, const struct GNUNET_PeerIdentity *key)
+GNUNET_CONTAINER_multipeermap_get (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+                                   const struct GNUNET_PeerIdentity *key)
 {
-  union MapEntry me;
+  unsigned int i;
 
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
-  {
-    struct SmallMapEntry *sme;
+  i = find_first (map, key);
+  if (i == map->map_length)
+    return NULL;
+  return value_at (map, i);
+}
+
+
+/**
+ * Remove the entry in slot @a i by shifting the following entries
+ * of the cluster back towards their home slots.
+ *
+ * @param map the map
+ * @param i slot to clear
+ */
+static void
+shift_back (struct GNUNET_CONTAINER_MultiPeerMap *map,
+            unsigned int i)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int j;
 
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity)))
-	return sme->value;
+  while (1)
+  {
+    j = (i + 1) & mask;
+    /* stop at empty slots and at entries in their home slot */
+    if ((map->info[j].dist & ~SLOT_DELETED) <= 1)
+      break;
+    map->info[i] = map->info[j];
+    map->info[i].dist--;
+    if (map->use_small_entries)
+      map->map.sme[i] = map->map.sme[j];
+    else
+      map->map.bme[i] = map->map.bme[j];
+    i = j;
   }
-  else
+  map->info[i].dist = 0;
+}
+
+
+/**
+ * Remove the entry in slot @a i.  If the map is being iterated over,
+ * the slot is only marked as deleted.
+ *
+ * @param map the map
+ * @param i slot of the entry
+ */
+static void
+remove_at (struct GNUNET_CONTAINER_MultiPeerMap *map,
+           unsigned int i)
+{
+  map->size--;
+  if (0 != map->iterating)
   {
-    struct BigMapEntry *bme;
+    map->info[i].dist |= SLOT_DELETED;
+    map->deleted++;
+    return;
+  }
+  shift_back (map, i);
+}
+
+
+/**
+ * Start an iteration over @a map, during which removed slots
+ * are not compacted.
+ *
+ * @param map the map
+ */
+static void
+iteration_start (const struct GNUNET_CONTAINER_MultiPeerMap *map)
+{
+  ((struct GNUNET_CONTAINER_MultiPeerMap *) map)->iterating++;
+}
+
+
+/**
+ * Finish an iteration over @a map.  Compacts the slots removed
+ * during the iteration (or frees the map if it was destroyed)
+ * once no iteration is running anymore.
+ *
+ * @param cmap the map
+ */
+static void
+iteration_done (const struct GNUNET_CONTAINER_MultiPeerMap *cmap)
+{
+  struct GNUNET_CONTAINER_MultiPeerMap *map;
+  unsigned int i;
 
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity)))
-	return bme->value;
+  map = (struct GNUNET_CONTAINER_MultiPeerMap *) cmap;
+  GNUNET_assert (map->iterating > 0);
+  map->iterating--;
+  if (0 != map->iterating)
+    return;
+  if (GNUNET_YES == map->destroy_pending)
+  {
+    GNUNET_CONTAINER_multipeermap_destroy (map);
+    return;
   }
-  return NULL;
+  if (0 == map->deleted)
+    return;
+  /* shifting only moves entries to lower slots (or from the
+     start of the array to its end), so one pass suffices */
+  i = 0;
+  while (i < map->map_length)
+  {
+    if (0 != (map->info[i].dist & SLOT_DELETED))
+      shift_back (map, i);
+    else
+      i++;
+  }
+  map->deleted = 0;
 }
 
 
@@ -321,50 +612,37 @@ GNUNET_CONTAINER_multipeermap_iterate (const struct
 {
   int count;
   unsigned int i;
-  union MapEntry me;
   struct GNUNET_PeerIdentity kc;
+  const struct GNUNET_PeerIdentity *key;
 
-  count = 0;
   GNUNET_assert (NULL != map);
-  for (i = 0; i < map->map_length; i++)
+  if (NULL == it)
+    return map->size;
+  count = 0;
+  iteration_start (map);
+  /* the map may grow while we iterate, so always re-check the length */
+  for (i = 0; (i < map->map_length) && (GNUNET_NO == map->destroy_pending); i++)
   {
-    me = map->map[i];
+    if ( (0 == map->info[i].dist) ||
+         (0 != (map->info[i].dist & SLOT_DELETED)) )
+      continue;
     if (map->use_small_entries)
     {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-	nxt = sme->next;
-	if (NULL != it)
-	{
-	  if (GNUNET_OK != it (it_cls, sme->key, sme->value))
-	    return GNUNET_SYSERR;
-	}
-	count++;
-      }
+      key = map->map.sme[i].key;
     }
     else
     {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-	nxt = bme->next;
-	if (NULL != it)
-	{
-	  kc = bme->key;
-	  if (GNUNET_OK != it (it_cls, &kc, bme->value))
-	    return GNUNET_SYSERR;
-	}
-	count++;
-      }
+      kc = map->map.bme[i].key;
+      key = &kc;
+    }
+    if (GNUNET_OK != it (it_cls, key, value_at (map, i)))
+    {
+      iteration_done (map);
+      return GNUNET_SYSERR;
     }
+    count++;
   }
+  iteration_done (map);
   return count;
 }
 
@@ -377,7 +655,7 @@ GNUNET_CONTAINER_multipeermap_iterate (const struct
  * @param map the map
  * @param key key of the key-value pair
  * @param value value of the key-value pair
- * @return GNUNET_YES on success, GNUNET_NO if the key-value pair
+ * @return #GNUNET_YES on success, #GNUNET_NO if the key-value pair
  *  is not in the map
  */
 int
@@ -385,56 +663,24 @@ GNUNET_CONTAINER_multipeermap_remove (struct GNUNET_CONTAINER_MultiPeerMap *map,
                                       const struct GNUNET_PeerIdentity *key,
 				      const void *value)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
   unsigned int i;
 
   map->modification_counter++;
 
-  i = idx_of (map, key);
-  me = map->map[i];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *p;
-
-    p = NULL;
-    for (sme = me.sme; NULL != sme; sme = sme->next)
+    if (value == value_at (map, i))
     {
-      if ((0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity))) &&
-	  (value == sme->value))
-      {
-	if (NULL == p)
-	  map->map[i].sme = sme->next;
-	else
-	  p->next = sme->next;
-	GNUNET_free (sme);
-	map->size--;
-	return GNUNET_YES;
-      }
-      p = sme;
-    }
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *p;
-
-    p = NULL;
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-    {
-      if ((0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity))) &&
-	  (value == bme->value))
-      {
-	if (NULL == p)
-	  map->map[i].bme = bme->next;
-	else
-	  p->next = bme->next;
-	GNUNET_free (bme);
-	map->size--;
-	return GNUNET_YES;
-      }
-      p = bme;
+      remove_at (map, i);
+      return GNUNET_YES;
     }
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
   return GNUNET_NO;
 }
@@ -449,76 +695,33 @@ GNUNET_CONTAINER_multipeermap_remove (struct GNUNET_CONTAINER_MultiPeerMap *map,
  * @return number of values removed
  */
 int
-GNUNET_CONTAINER_multipeermap_remove_all (struct GNUNET_CONTAINER_MultiPeerMap
-                                          *map, const struct GNUNET_PeerIdentity *key)
+GNUNET_CONTAINER_multipeermap_remove_all (struct GNUNET_CONTAINER_MultiPeerMap *map,
+                                          const struct GNUNET_PeerIdentity *key)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
   unsigned int i;
   int ret;
 
   map->modification_counter++;
 
   ret = 0;
-  i = idx_of (map, key);
-  me = map->map[i];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *p;
-
-    p = NULL;
-    sme = me.sme;
-    while (NULL != sme)
+    remove_at (map, i);
+    ret++;
+    if (0 == map->iterating)
     {
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity)))
-      {
-	if (NULL == p)
-	  map->map[i].sme = sme->next;
-	else
-	  p->next = sme->next;
-	GNUNET_free (sme);
-	map->size--;
-	if (NULL == p)
-	  sme = map->map[i].sme;
-	else
-	  sme = p->next;
-	ret++;
-      }
-      else
-      {
-	p = sme;
-	sme = sme->next;
-      }
+      /* the next entry of the cluster moved into slot i */
+      i = find_from (map, hash, key, i, dist, &dist);
     }
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *p;
-
-    p = NULL;
-    bme = me.bme;
-    while (NULL != bme)
+    else
     {
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity)))
-      {
-	if (NULL == p)
-	  map->map[i].bme = bme->next;
-	else
-	  p->next = bme->next;
-	GNUNET_free (bme);
-	map->size--;
-	if (NULL == p)
-	  bme = map->map[i].bme;
-	else
-	  bme = p->next;
-	ret++;
-      }
-      else
-      {
-	p = bme;
-	bme = bme->next;
-      }
+      i = find_from (map, hash, key,
+                     (i + 1) & (map->map_length - 1), dist + 1,
+                     &dist);
     }
   }
   return ret;
@@ -531,34 +734,15 @@ GNUNET_CONTAINER_multipeermap_remove_all (struct GNUNET_CONTAINER_MultiPeerMap
  *
  * @param map the map
  * @param key the key to test if a value exists for it
- * @return GNUNET_YES if such a value exists,
- *         GNUNET_NO if not
+ * @return #GNUNET_YES if such a value exists,
+ *         #GNUNET_NO if not
  */
 int
 GNUNET_CONTAINER_multipeermap_contains (const struct
                                         GNUNET_CONTAINER_MultiPeerMap *map,
                                         const struct GNUNET_PeerIdentity *key)
 {
-  union MapEntry me;
-
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
-  {
-    struct SmallMapEntry *sme;
-
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity)))
-	return GNUNET_YES;
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity)))
-	return GNUNET_YES;
-  }
-  return GNUNET_NO;
+  return (find_first (map, key) != map->map_length) ? GNUNET_YES : GNUNET_NO;
 }
 
 
@@ -569,8 +753,8 @@ GNUNET_CONTAINER_multipeermap_contains (const struct
  * @param map the map
  * @param key the key to test if a value exists for it
  * @param value value to test for
- * @return GNUNET_YES if such a value exists,
- *         GNUNET_NO if not
+ * @return #GNUNET_YES if such a value exists,
+ *         #GNUNET_NO if not
  */
 int
 GNUNET_CONTAINER_multipeermap_contains_value (const struct
@@ -578,28 +762,85 @@ GNUNET_CONTAINER_multipeermap_contains_value (const struct
                                               *map, const struct GNUNET_PeerIdentity *key,
                                               const void *value)
 {
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
+  unsigned int i;
 
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while (i != map->map_length)
   {
-    struct SmallMapEntry *sme;
-
-    for (sme = me.sme; NULL != sme; sme = sme->next)
-      if ( (0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity))) &&
-	   (sme->value == value) )
-	return GNUNET_YES;
+    if (value == value_at (map, i))
+      return GNUNET_YES;
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
-  else
-  {
-    struct BigMapEntry *bme;
+  return GNUNET_NO;
+}
+
 
-    for (bme = me.bme; NULL != bme; bme = bme->next)
-      if ( (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity))) &&
-	   (bme->value == value) )
-	return GNUNET_YES;
+/**
+ * Insert an entry into the slot array, without checking for
+ * duplicates or growing the map.
+ *
+ * @param map the map
+ * @param hash hash of the key, from hash_of()
+ * @param ec the entry to insert
+ */
+static void
+insert (struct GNUNET_CONTAINER_MultiPeerMap *map,
+        uint32_t hash,
+        const union EntryCopy *ec)
+{
+  unsigned int mask = map->map_length - 1;
+  unsigned int i;
+  struct SlotInfo carry;
+  struct SlotInfo si;
+  union EntryCopy cur;
+  union EntryCopy tmp;
+
+  carry.hash = hash;
+  carry.dist = 1;
+  cur = *ec;
+  i = idx_of (map, hash);
+  while (1)
+  {
+    si = map->info[i];
+    if ( (0 == si.dist) ||
+         ( (0 != (si.dist & SLOT_DELETED)) &&
+           ((si.dist & ~SLOT_DELETED) <= carry.dist) ) )
+    {
+      /* free slot, or a deleted one we may take over */
+      if (0 != si.dist)
+        map->deleted--;
+      map->info[i] = carry;
+      if (map->use_small_entries)
+        map->map.sme[i] = cur.sme;
+      else
+        map->map.bme[i] = cur.bme;
+      return;
+    }
+    if ((si.dist & ~SLOT_DELETED) < carry.dist)
+    {
+      /* Robin Hood: take the slot from the entry closer to home */
+      map->info[i] = carry;
+      carry = si;
+      if (map->use_small_entries)
+      {
+        tmp.sme = map->map.sme[i];
+        map->map.sme[i] = cur.sme;
+      }
+      else
+      {
+        tmp.bme = map->map.bme[i];
+        map->map.bme[i] = cur.bme;
+      }
+      cur = tmp;
+    }
+    i = (i + 1) & mask;
+    carry.dist++;
   }
-  return GNUNET_NO;
 }
 
 
@@ -611,49 +852,36 @@ GNUNET_CONTAINER_multipeermap_contains_value (const struct
 static void
 grow (struct GNUNET_CONTAINER_MultiPeerMap *map)
 {
-  union MapEntry *old_map;
-  union MapEntry *new_map;
+  struct SlotInfo *old_info;
+  union MapEntry old_map;
+  union EntryCopy ec;
   unsigned int old_len;
-  unsigned int new_len;
-  unsigned int idx;
   unsigned int i;
 
   map->modification_counter++;
 
+  old_info = map->info;
   old_map = map->map;
   old_len = map->map_length;
-  new_len = old_len * 2;
-  new_map = GNUNET_malloc (sizeof (union MapEntry) * new_len);
-  map->map_length = new_len;
-  map->map = new_map;
+  alloc_slots (map, old_len * 2);
+  /* deleted slots are dropped while rehashing */
+  map->deleted = 0;
   for (i = 0; i < old_len; i++)
   {
+    if ( (0 == old_info[i].dist) ||
+         (0 != (old_info[i].dist & SLOT_DELETED)) )
+      continue;
     if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-
-      while (NULL != (sme = old_map[i].sme))
-      {
-	old_map[i].sme = sme->next;
-	idx = idx_of (map, sme->key);
-	sme->next = new_map[idx].sme;
-	new_map[idx].sme = sme;
-      }
-    }
+      ec.sme = old_map.sme[i];
     else
-    {
-      struct BigMapEntry *bme;
-
-      while (NULL != (bme = old_map[i].bme))
-      {
-	old_map[i].bme = bme->next;
-	idx = idx_of (map, &bme->key);
-	bme->next = new_map[idx].bme;
-	new_map[idx].bme = bme;
-      }
-    }
+      ec.bme = old_map.bme[i];
+    insert (map, old_info[i].hash, &ec);
   }
-  GNUNET_free (old_map);
+  if (map->use_small_entries)
+    GNUNET_free (old_map.sme);
+  else
+    GNUNET_free (old_map.bme);
+  GNUNET_free (old_info);
 }
 
 
@@ -666,7 +894,7 @@ grow (struct GNUNET_CONTAINER_MultiPeerMap *map)
  * @param opt options for put
  * @return #GNUNET_OK on success,
  *         #GNUNET_NO if a value was replaced (with REPLACE)
- *         #GNUNET_SYSERR if GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY was the option and the
+ *         #GNUNET_SYSERR if UNIQUE_ONLY was the option and the
  *                       value already exists
  */
 int
@@ -675,66 +903,38 @@ GNUNET_CONTAINER_multipeermap_put (struct GNUNET_CONTAINER_MultiPeerMap *map,
 				   void *value,
                                    enum GNUNET_CONTAINER_MultiHashMapOption opt)
 {
-  union MapEntry me;
+  union EntryCopy ec;
   unsigned int i;
 
-  i = idx_of (map, key);
   if ((opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE) &&
       (opt != GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST))
   {
-    me = map->map[i];
-    if (map->use_small_entries)
-    {
-      struct SmallMapEntry *sme;
-
-      for (sme = me.sme; NULL != sme; sme = sme->next)
-	if (0 == memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity)))
-	{
-	  if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
-	    return GNUNET_SYSERR;
-	  sme->value = value;
-	  return GNUNET_NO;
-	}
-    }
-    else
+    i = find_first (map, key);
+    if (i != map->map_length)
     {
-      struct BigMapEntry *bme;
-
-      for (bme = me.bme; NULL != bme; bme = bme->next)
-	if (0 == memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity)))
-	{
-	  if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
-	    return GNUNET_SYSERR;
-	  bme->value = value;
-	  return GNUNET_NO;
-	}
+      if (opt == GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY)
+        return GNUNET_SYSERR;
+      if (map->use_small_entries)
+        map->map.sme[i].value = value;
+      else
+        map->map.bme[i].value = value;
+      return GNUNET_NO;
     }
   }
-  if (map->size / 3 >= map->map_length / 4)
-  {
+  if ((map->size + map->deleted + 1) * 8 >
+      map->map_length * MAX_LOAD_EIGHTHS)
     grow (map);
-    i = idx_of (map, key);
-  }
   if (map->use_small_entries)
   {
-    struct SmallMapEntry *sme;
-
-    sme = GNUNET_new (struct SmallMapEntry);
-    sme->key = key;
-    sme->value = value;
-    sme->next = map->map[i].sme;
-    map->map[i].sme = sme;
+    ec.sme.key = key;
+    ec.sme.value = value;
   }
   else
   {
-    struct BigMapEntry *bme;
-
-    bme = GNUNET_new (struct BigMapEntry);
-    bme->key = *key;
-    bme->value = value;
-    bme->next = map->map[i].bme;
-    map->map[i].bme = bme;
+    ec.bme.key = *key;
+    ec.bme.value = value;
   }
+  insert (map, hash_of (key), &ec);
   map->size++;
   return GNUNET_OK;
 }
@@ -746,53 +946,40 @@ GNUNET_CONTAINER_multipeermap_put (struct GNUNET_CONTAINER_MultiPeerMap *map,
  * @param map the map
  * @param key key that the entries must correspond to
  * @param it function to call on each entry
- * @param it_cls extra argument to @a it
+ * @param it_cls extra argument to it
  * @return the number of key value pairs processed,
  *         #GNUNET_SYSERR if it aborted iteration
  */
 int
-GNUNET_CONTAINER_multipeermap_get_multiple (const struct GNUNET_CONTAINER_MultiPeerMap *map,
+GNUNET_CONTAINER_multipeermap_get_multiple (const struct
+                                            GNUNET_CONTAINER_MultiPeerMap *map,
                                             const struct GNUNET_PeerIdentity *key,
                                             GNUNET_CONTAINER_PeerMapIterator it,
                                             void *it_cls)
 {
   int count;
-  union MapEntry me;
+  uint32_t hash;
+  uint32_t dist;
+  unsigned int i;
 
   count = 0;
-  me = map->map[idx_of (map, key)];
-  if (map->use_small_entries)
+  hash = hash_of (key);
+  iteration_start (map);
+  i = find_from (map, hash, key, idx_of (map, hash), 1, &dist);
+  while ( (i != map->map_length) &&
+          (GNUNET_NO == map->destroy_pending) )
   {
-    struct SmallMapEntry *sme;
-    struct SmallMapEntry *nxt;
-
-    nxt = me.sme;
-    while (NULL != (sme = nxt))
-    {
-      nxt = sme->next;
-      if (0 != memcmp (key, sme->key, sizeof (struct GNUNET_PeerIdentity)))
-	continue;
-      if ((it != NULL) && (GNUNET_OK != it (it_cls, key, sme->value)))
-	return GNUNET_SYSERR;
-      count++;
-    }
-  }
-  else
-  {
-    struct BigMapEntry *bme;
-    struct BigMapEntry *nxt;
-
-    nxt = me.bme;
-    while (NULL != (bme = nxt))
+    if ((it != NULL) && (GNUNET_OK != it (it_cls, key, value_at (map, i))))
     {
-      nxt = bme->next;
-      if (0 != memcmp (key, &bme->key, sizeof (struct GNUNET_PeerIdentity)))
-	continue;
-      if ((it != NULL) && (GNUNET_OK != it (it_cls, key, bme->value)))
-	return GNUNET_SYSERR;
-      count++;
+      iteration_done (map);
+      return GNUNET_SYSERR;
     }
+    count++;
+    i = find_from (map, hash, key,
+                   (i + 1) & (map->map_length - 1), dist + 1,
+                   &dist);
   }
+  iteration_done (map);
   return count;
 }
 
@@ -800,7 +987,7 @@ GNUNET_CONTAINER_multipeermap_get_multiple (const struct GNUNET_CONTAINER_MultiP
 /**
  * @ingroup hashmap
  * Call @a it on a random value from the map, or not at all
- * if the map is empty.  Note that this function has linear
+ * if the map is empty. Note that this function has linear
  * complexity (in the size of the map).
  *
  * @param map the map
@@ -815,7 +1002,6 @@ GNUNET_CONTAINER_multipeermap_get_random (const struct GNUNET_CONTAINER_MultiPee
 {
   unsigned int off;
   unsigned int idx;
-  union MapEntry me;
 
   if (0 == map->size)
     return 0;
@@ -825,46 +1011,18 @@ GNUNET_CONTAINER_multipeermap_get_random (const struct GNUNET_CONTAINER_MultiPee
                                   map->size);
   for (idx = 0; idx < map->map_length; idx++)
   {
-    me = map->map[idx];
-    if (map->use_small_entries)
+    if ( (0 == map->info[idx].dist) ||
+         (0 != (map->info[idx].dist & SLOT_DELETED)) )
+      continue;
+    if (0 == off)
     {
-      struct SmallMapEntry *sme;
-      struct SmallMapEntry *nxt;
-
-      nxt = me.sme;
-      while (NULL != (sme = nxt))
-      {
-        nxt = sme->next;
-        if (0 == off)
-        {
-          if (GNUNET_OK != it (it_cls,
-                               sme->key,
-                               sme->value))
-            return GNUNET_SYSERR;
-          return 1;
-        }
-        off--;
-      }
-    }
-    else
-    {
-      struct BigMapEntry *bme;
-      struct BigMapEntry *nxt;
-
-      nxt = me.bme;
-      while (NULL != (bme = nxt))
-      {
-        nxt = bme->next;
-        if (0 == off)
-        {
-          if (GNUNET_OK != it (it_cls,
-                               &bme->key, bme->value))
-            return GNUNET_SYSERR;
-          return 1;
-        }
-        off--;
-      }
+      if (GNUNET_OK != it (it_cls,
+                           key_at (map, idx),
+                           value_at (map, idx)))
+        return GNUNET_SYSERR;
+      return 1;
     }
+    off--;
   }
   GNUNET_break (0);
   return GNUNET_SYSERR;
@@ -875,7 +1033,7 @@ GNUNET_CONTAINER_multipeermap_get_random (const struct GNUNET_CONTAINER_MultiPee
  * Create an iterator for a multipeermap.
  * The iterator can be used to retrieve all the elements in the multipeermap
  * one by one, without having to handle all elements at once (in contrast to
- * #GNUNET_CONTAINER_multipeermap_iterate).  Note that the iterator can not be
+ * GNUNET_CONTAINER_multipeermap_iterate()).  Note that the iterator can not be
  * used anymore if elements have been removed from 'map' after the creation of
  * the iterator, or 'map' has been destroyed.  Adding elements to 'map' may
  * result in skipped or repeated elements.
@@ -891,7 +1049,6 @@ GNUNET_CONTAINER_multipeermap_iterator_create (const struct GNUNET_CONTAINER_Mul
   iter = GNUNET_new (struct GNUNET_CONTAINER_MultiPeerMapIterator);
   iter->map = map;
   iter->modification_counter = map->modification_counter;
-  iter->me = map->map[0];
   return iter;
 }
 
@@ -912,44 +1069,28 @@ GNUNET_CONTAINER_multipeermap_iterator_create (const struct GNUNET_CONTAINER_Mul
  */
 int
 GNUNET_CONTAINER_multipeermap_iterator_next (struct GNUNET_CONTAINER_MultiPeerMapIterator *iter,
-                                             struct GNUNET_PeerIdentity *key, const void **value)
+                                             struct GNUNET_PeerIdentity *key,
+                                             const void **value)
 {
+  const struct GNUNET_CONTAINER_MultiPeerMap *map = iter->map;
+
   /* make sure the map has not been modified */
-  GNUNET_assert (iter->modification_counter == iter->map->modification_counter);
+  GNUNET_assert (iter->modification_counter == map->modification_counter);
 
-  /* look for the next entry, skipping empty buckets */
-  while (1)
+  /* look for the next entry, skipping empty slots */
+  for (; iter->idx < map->map_length; iter->idx++)
   {
-    if (iter->idx >= iter->map->map_length)
-      return GNUNET_NO;
-    if (GNUNET_YES == iter->map->use_small_entries)
-    {
-      if (NULL != iter->me.sme)
-      {
-        if (NULL != key)
-          *key = *iter->me.sme->key;
-        if (NULL != value)
-          *value = iter->me.sme->value;
-        iter->me.sme = iter->me.sme->next;
-        return GNUNET_YES;
-      }
-    }
-    else
-    {
-      if (NULL != iter->me.bme)
-      {
-        if (NULL != key)
-          *key = iter->me.bme->key;
-        if (NULL != value)
-          *value = iter->me.bme->value;
-        iter->me.bme = iter->me.bme->next;
-        return GNUNET_YES;
-      }
-    }
-    iter->idx += 1;
-    if (iter->idx < iter->map->map_length)
-      iter->me = iter->map->map[iter->idx];
+    if ( (0 == map->info[iter->idx].dist) ||
+         (0 != (map->info[iter->idx].dist & SLOT_DELETED)) )
+      continue;
+    if (NULL != key)
+      *key = *key_at (map, iter->idx);
+    if (NULL != value)
+      *value = value_at (map, iter->idx);
+    iter->idx++;
+    return GNUNET_YES;
   }
+  return GNUNET_NO;
 }
 
 
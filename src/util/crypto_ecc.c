@@ -27,6 +27,9 @@
 #include <gcrypt.h>
 #include "gnunet_crypto_lib.h"
 #include "gnunet_strings_lib.h"
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define EXTRA_CHECKS 0
 
@@ -51,6 +54,82 @@
  */
 #define LOG_GCRY(level, cmd, rc) do { LOG(level, _("`%s' failed at %s:%d with error: %s\n"), cmd, __FILE__, __LINE__, gcry_strerror(rc)); } while(0)
 
+/**
+ * Number of public key S-expressions we cache per key type.
+ * Must be a power of two.
+ */
+#define PUB_SEXP_CACHE_SIZE 64
+
+
+/**
+ * Entry in a cache of public key S-expressions.
+ */
+struct PubSexpCacheEntry
+{
+  /**
+   * Compressed public key the S-expression was built from.
+   */
+  unsigned char q_y[256 / 8];
+
+  /**
+   * S-expression for @e q_y, NULL if the slot is empty.
+   */
+  gcry_sexp_t sexp;
+};
+
+
+/**
+ * Entry caching the S-expression of the private key we last
+ * signed with (typically always our own peer or ego key).
+ */
+struct PrivSexpCacheEntry
+{
+  /**
+   * Private key the S-expression was built from.
+   */
+  unsigned char d[256 / 8];
+
+  /**
+   * S-expression for @e d, NULL if not yet set.
+   */
+  gcry_sexp_t sexp;
+};
+
+
+/**
+ * Cache of EdDSA public key S-expressions (direct-mapped).
+ */
+static struct PubSexpCacheEntry eddsa_pub_cache[PUB_SEXP_CACHE_SIZE];
+
+/**
+ * Cache of ECDSA public key S-expressions (direct-mapped).
+ */
+static struct PubSexpCacheEntry ecdsa_pub_cache[PUB_SEXP_CACHE_SIZE];
+
+/**
+ * EdDSA private key we last signed with.
+ */
+static struct PrivSexpCacheEntry eddsa_priv_cache;
+
+/**
+ * ECDSA private key we last signed with.
+ */
+static struct PrivSexpCacheEntry ecdsa_priv_cache;
+
+#if HAVE_PTHREAD
+/**
+ * Protects the S-expression caches, which are also used from the
+ * workers of the crypto offload pool.
+ */
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define CACHE_LOCK() GNUNET_assert (0 == pthread_mutex_lock (&cache_lock))
+#define CACHE_UNLOCK() GNUNET_assert (0 == pthread_mutex_unlock (&cache_lock))
+#else
+#define CACHE_LOCK() do {} while (0)
+#define CACHE_UNLOCK() do {} while (0)
+#endif
+
 
 /**
  * Extract values from an S-expression.
@@ -114,6 +193,197 @@ key_from_sexp (gcry_mpi_t * array,
 }
 
 
+/**
+ * Find the cache slot for a public key.
+ *
+ * @param cache cache to use (#eddsa_pub_cache or #ecdsa_pub_cache)
+ * @param q_y compressed public key
+ * @return the slot @a q_y maps to
+ */
+static struct PubSexpCacheEntry *
+pub_sexp_slot (struct PubSexpCacheEntry *cache,
+               const unsigned char *q_y)
+{
+  /* public keys are (compressed) curve points, so their bytes
+     are well distributed */
+  return &cache[(q_y[0] | (q_y[1] << 8)) & (PUB_SEXP_CACHE_SIZE - 1)];
+}
+
+
+/**
+ * Obtain the S-expression for a public key, taking it out of the
+ * cache if it is there and building it otherwise.  The caller owns
+ * the result and must either return it with #pub_sexp_put() or
+ * release it.  Does not log, as it is used from the crypto offload
+ * pool.
+ *
+ * @param cache cache to use (#eddsa_pub_cache or #ecdsa_pub_cache)
+ * @param q_y compressed public key
+ * @param eddsa #GNUNET_YES to build an EdDSA key, #GNUNET_NO for ECDSA
+ * @return NULL on error
+ */
+static gcry_sexp_t
+pub_sexp_get (struct PubSexpCacheEntry *cache,
+              const unsigned char *q_y,
+              int eddsa)
+{
+  struct PubSexpCacheEntry *e;
+  gcry_sexp_t sexp;
+
+  e = pub_sexp_slot (cache, q_y);
+  sexp = NULL;
+  CACHE_LOCK ();
+  if ( (NULL != e->sexp) &&
+       (0 == memcmp (e->q_y, q_y, sizeof (e->q_y))) )
+  {
+    sexp = e->sexp;
+    e->sexp = NULL;
+  }
+  CACHE_UNLOCK ();
+  if (NULL != sexp)
+    return sexp;
+  if (GNUNET_YES == eddsa)
+  {
+    if (0 != gcry_sexp_build (&sexp, NULL,
+                              "(public-key(ecc(curve " CURVE ")(flags eddsa)(q %b)))",
+                              (int) sizeof (e->q_y), q_y))
+      return NULL;
+  }
+  else
+  {
+    if (0 != gcry_sexp_build (&sexp, NULL,
+                              "(public-key(ecc(curve " CURVE ")(q %b)))",
+                              (int) sizeof (e->q_y), q_y))
+      return NULL;
+  }
+  return sexp;
+}
+
+
+/**
+ * Return the S-expression for a public key obtained with
+ * #pub_sexp_get() to the cache, replacing whatever key was
+ * cached in its slot.
+ *
+ * @param cache cache to use (#eddsa_pub_cache or #ecdsa_pub_cache)
+ * @param q_y compressed public key
+ * @param sexp S-expression for @a q_y, ownership passes to the cache
+ */
+static void
+pub_sexp_put (struct PubSexpCacheEntry *cache,
+              const unsigned char *q_y,
+              gcry_sexp_t sexp)
+{
+  struct PubSexpCacheEntry *e;
+  gcry_sexp_t old;
+
+  e = pub_sexp_slot (cache, q_y);
+  CACHE_LOCK ();
+  if ( (NULL != e->sexp) &&
+       (0 == memcmp (e->q_y, q_y, sizeof (e->q_y))) )
+  {
+    /* another thread cached the same key meanwhile */
+    old = sexp;
+  }
+  else
+  {
+    old = e->sexp;
+    e->sexp = sexp;
+    memcpy (e->q_y, q_y, sizeof (e->q_y));
+  }
+  CACHE_UNLOCK ();
+  if (NULL != old)
+    gcry_sexp_release (old);
+}
+
+
+/**
+ * Take the S-expression for a private key out of the cache.  The
+ * caller owns the result and should return it with #priv_sexp_put().
+ *
+ * @param cache cache to use (#eddsa_priv_cache or #ecdsa_priv_cache)
+ * @param d private key
+ * @return NULL if @a d is not cached
+ */
+static gcry_sexp_t
+priv_sexp_take (struct PrivSexpCacheEntry *cache,
+                const unsigned char *d)
+{
+  gcry_sexp_t sexp;
+
+  sexp = NULL;
+  CACHE_LOCK ();
+  if ( (NULL != cache->sexp) &&
+       (0 == memcmp (cache->d, d, sizeof (cache->d))) )
+  {
+    sexp = cache->sexp;
+    cache->sexp = NULL;
+  }
+  CACHE_UNLOCK ();
+  return sexp;
+}
+
+
+/**
+ * Return the S-expression for a private key to the cache, replacing
+ * the key cached before.
+ *
+ * @param cache cache to use (#eddsa_priv_cache or #ecdsa_priv_cache)
+ * @param d private key
+ * @param sexp S-expression for @a d, ownership passes to the cache
+ */
+static void
+priv_sexp_put (struct PrivSexpCacheEntry *cache,
+               const unsigned char *d,
+               gcry_sexp_t sexp)
+{
+  gcry_sexp_t old;
+
+  CACHE_LOCK ();
+  if ( (NULL != cache->sexp) &&
+       (0 == memcmp (cache->d, d, sizeof (cache->d))) )
+  {
+    /* another thread cached the same key meanwhile */
+    old = sexp;
+  }
+  else
+  {
+    old = cache->sexp;
+    cache->sexp = sexp;
+    memcpy (cache->d, d, sizeof (cache->d));
+  }
+  CACHE_UNLOCK ();
+  if (NULL != old)
+    gcry_sexp_release (old);
+}
+
+
+/**
+ * Release all cached S-expressions, wiping cached private keys.
+ */
+static void __attribute__ ((destructor))
+ecc_sexp_cache_fini ()
+{
+  unsigned int i;
+
+  for (i = 0; i < PUB_SEXP_CACHE_SIZE; i++)
+  {
+    if (NULL != eddsa_pub_cache[i].sexp)
+      gcry_sexp_release (eddsa_pub_cache[i].sexp);
+    eddsa_pub_cache[i].sexp = NULL;
+    if (NULL != ecdsa_pub_cache[i].sexp)
+      gcry_sexp_release (ecdsa_pub_cache[i].sexp);
+    ecdsa_pub_cache[i].sexp = NULL;
+  }
+  if (NULL != eddsa_priv_cache.sexp)
+    gcry_sexp_release (eddsa_priv_cache.sexp);
+  if (NULL != ecdsa_priv_cache.sexp)
+    gcry_sexp_release (ecdsa_priv_cache.sexp);
+  memset (&eddsa_priv_cache, 0, sizeof (eddsa_priv_cache));
+  memset (&ecdsa_priv_cache, 0, sizeof (ecdsa_priv_cache));
+}
+
+
 /**
  * Convert the given private key from the network format to the
  * S-expression that can be used by libgcrypt.
@@ -677,54 +947,48 @@ GNUNET_CRYPTO_cmp_peer_identity (const struct GNUNET_PeerIdentity *first,
 
 /**
  * Convert the data specified in the given purpose argument to an
- * S-expression suitable for signature operations.
+ * S-expression suitable for signature operations.  Does not
+ * log, as it is used from the crypto offload pool.
  *
  * @param purpose data to convert
- * @return converted s-expression
+ * @return converted s-expression, NULL on error
  */
 static gcry_sexp_t
 data_to_eddsa_value (const struct GNUNET_CRYPTO_EccSignaturePurpose *purpose)
 {
   struct GNUNET_HashCode hc;
   gcry_sexp_t data;
-  int rc;
 
   GNUNET_CRYPTO_hash (purpose, ntohl (purpose->size), &hc);
-  if (0 != (rc = gcry_sexp_build (&data, NULL,
-				  "(data(flags eddsa)(hash-algo %s)(value %b))",
-				  "sha512",
-				  (int)sizeof (hc), &hc)))
-  {
-    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR, "gcry_sexp_build", rc);
+  if (0 != gcry_sexp_build (&data, NULL,
+                            "(data(flags eddsa)(hash-algo %s)(value %b))",
+                            "sha512",
+                            (int)sizeof (hc), &hc))
     return NULL;
-  }
   return data;
 }
 
 
 /**
  * Convert the data specified in the given purpose argument to an
- * S-expression suitable for signature operations.
+ * S-expression suitable for signature operations.  Does not
+ * log, as it is used from the crypto offload pool.
  *
  * @param purpose data to convert
- * @return converted s-expression
+ * @return converted s-expression, NULL on error
  */
 static gcry_sexp_t
 data_to_ecdsa_value (const struct GNUNET_CRYPTO_EccSignaturePurpose *purpose)
 {
   struct GNUNET_HashCode hc;
   gcry_sexp_t data;
-  int rc;
 
   GNUNET_CRYPTO_hash (purpose, ntohl (purpose->size), &hc);
-  if (0 != (rc = gcry_sexp_build (&data, NULL,
-				  "(data(flags rfc6979)(hash %s %b))",
-				  "sha512",
-				  (int)sizeof (hc), &hc)))
-  {
-    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR, "gcry_sexp_build", rc);
+  if (0 != gcry_sexp_build (&data, NULL,
+                            "(data(flags rfc6979)(hash %s %b))",
+                            "sha512",
+                            (int)sizeof (hc), &hc))
     return NULL;
-  }
   return data;
 }
 
@@ -748,19 +1012,19 @@ GNUNET_CRYPTO_ecdsa_sign (const struct GNUNET_CRYPTO_EcdsaPrivateKey *priv,
   int rc;
   gcry_mpi_t rs[2];
 
-  priv_sexp = decode_private_ecdsa_key (priv);
+  if (NULL == (priv_sexp = priv_sexp_take (&ecdsa_priv_cache, priv->d)))
+    priv_sexp = decode_private_ecdsa_key (priv);
   data = data_to_ecdsa_value (purpose);
-  if (0 != (rc = gcry_pk_sign (&sig_sexp, data, priv_sexp)))
+  rc = gcry_pk_sign (&sig_sexp, data, priv_sexp);
+  gcry_sexp_release (data);
+  priv_sexp_put (&ecdsa_priv_cache, priv->d, priv_sexp);
+  if (0 != rc)
   {
     LOG (GNUNET_ERROR_TYPE_WARNING,
          _("ECC signing failed at %s:%d: %s\n"), __FILE__,
          __LINE__, gcry_strerror (rc));
-    gcry_sexp_release (data);
-    gcry_sexp_release (priv_sexp);
     return GNUNET_SYSERR;
   }
-  gcry_sexp_release (priv_sexp);
-  gcry_sexp_release (data);
 
   /* extract 'r' and 's' values from sexpression 'sig_sexp' and store in
      'signature' */
@@ -798,19 +1062,19 @@ GNUNET_CRYPTO_eddsa_sign (const struct GNUNET_CRYPTO_EddsaPrivateKey *priv,
   int rc;
   gcry_mpi_t rs[2];
 
-  priv_sexp = decode_private_eddsa_key (priv);
+  if (NULL == (priv_sexp = priv_sexp_take (&eddsa_priv_cache, priv->d)))
+    priv_sexp = decode_private_eddsa_key (priv);
   data = data_to_eddsa_value (purpose);
-  if (0 != (rc = gcry_pk_sign (&sig_sexp, data, priv_sexp)))
+  rc = gcry_pk_sign (&sig_sexp, data, priv_sexp);
+  gcry_sexp_release (data);
+  priv_sexp_put (&eddsa_priv_cache, priv->d, priv_sexp);
+  if (0 != rc)
   {
     LOG (GNUNET_ERROR_TYPE_WARNING,
          _("EdDSA signing failed at %s:%d: %s\n"), __FILE__,
          __LINE__, gcry_strerror (rc));
-    gcry_sexp_release (data);
-    gcry_sexp_release (priv_sexp);
     return GNUNET_SYSERR;
   }
-  gcry_sexp_release (priv_sexp);
-  gcry_sexp_release (data);
 
   /* extract 'r' and 's' values from sexpression 'sig_sexp' and store in
      'signature' */
@@ -830,7 +1094,7 @@ GNUNET_CRYPTO_eddsa_sign (const struct GNUNET_CRYPTO_EddsaPrivateKey *priv,
 
 
 /**
- * Verify signature.
+ * Verify signature without logging.
  *
  * @param purpose what is the purpose that the signature should have?
  * @param validate block to validate (size, purpose, data)
@@ -839,10 +1103,10 @@ GNUNET_CRYPTO_eddsa_sign (const struct GNUNET_CRYPTO_EddsaPrivateKey *priv,
  * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
  */
 int
-GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
-                            const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
-                            const struct GNUNET_CRYPTO_EcdsaSignature *sig,
-                            const struct GNUNET_CRYPTO_EcdsaPublicKey *pub)
+GNUNET_CRYPTO_ecdsa_verify_nolog (uint32_t purpose,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                  const struct GNUNET_CRYPTO_EcdsaSignature *sig,
+                                  const struct GNUNET_CRYPTO_EcdsaPublicKey *pub)
 {
   gcry_sexp_t data;
   gcry_sexp_t sig_sexpr;
@@ -853,32 +1117,50 @@ GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
     return GNUNET_SYSERR;       /* purpose mismatch */
 
   /* build s-expression for signature */
-  if (0 != (rc = gcry_sexp_build (&sig_sexpr, NULL,
-				  "(sig-val(ecdsa(r %b)(s %b)))",
-                                  (int)sizeof (sig->r), sig->r,
-                                  (int)sizeof (sig->s), sig->s)))
-  {
-    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR, "gcry_sexp_build", rc);
+  if (0 != gcry_sexp_build (&sig_sexpr, NULL,
+                            "(sig-val(ecdsa(r %b)(s %b)))",
+                            (int)sizeof (sig->r), sig->r,
+                            (int)sizeof (sig->s), sig->s))
     return GNUNET_SYSERR;
-  }
   data = data_to_ecdsa_value (validate);
-  if (0 != (rc = gcry_sexp_build (&pub_sexpr, NULL,
-                            "(public-key(ecc(curve " CURVE ")(q %b)))",
-                                  (int)sizeof (pub->q_y), pub->q_y)))
+  if (NULL == (pub_sexpr = pub_sexp_get (ecdsa_pub_cache,
+                                         pub->q_y,
+                                         GNUNET_NO)))
   {
     gcry_sexp_release (data);
     gcry_sexp_release (sig_sexpr);
     return GNUNET_SYSERR;
   }
   rc = gcry_pk_verify (sig_sexpr, data, pub_sexpr);
-  gcry_sexp_release (pub_sexpr);
+  pub_sexp_put (ecdsa_pub_cache, pub->q_y, pub_sexpr);
   gcry_sexp_release (data);
   gcry_sexp_release (sig_sexpr);
   if (0 != rc)
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Verify signature.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
+ */
+int
+GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
+                            const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                            const struct GNUNET_CRYPTO_EcdsaSignature *sig,
+                            const struct GNUNET_CRYPTO_EcdsaPublicKey *pub)
+{
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_ecdsa_verify_nolog (purpose, validate, sig, pub))
   {
     LOG (GNUNET_ERROR_TYPE_INFO,
-         _("ECDSA signature verification failed at %s:%d: %s\n"), __FILE__,
-         __LINE__, gcry_strerror (rc));
+         _("ECDSA signature verification failed\n"));
     return GNUNET_SYSERR;
   }
   return GNUNET_OK;
@@ -887,7 +1169,7 @@ GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
 
 
 /**
- * Verify signature.
+ * Verify signature without logging.
  *
  * @param purpose what is the purpose that the signature should have?
  * @param validate block to validate (size, purpose, data)
@@ -896,10 +1178,10 @@ GNUNET_CRYPTO_ecdsa_verify (uint32_t purpose,
  * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
  */
 int
-GNUNET_CRYPTO_eddsa_verify (uint32_t purpose,
-                            const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
-                            const struct GNUNET_CRYPTO_EddsaSignature *sig,
-                            const struct GNUNET_CRYPTO_EddsaPublicKey *pub)
+GNUNET_CRYPTO_eddsa_verify_nolog (uint32_t purpose,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                  const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                                  const struct GNUNET_CRYPTO_EddsaPublicKey *pub)
 {
   gcry_sexp_t data;
   gcry_sexp_t sig_sexpr;
@@ -910,38 +1192,97 @@ GNUNET_CRYPTO_eddsa_verify (uint32_t purpose,
     return GNUNET_SYSERR;       /* purpose mismatch */
 
   /* build s-expression for signature */
-  if (0 != (rc = gcry_sexp_build (&sig_sexpr, NULL,
-				  "(sig-val(eddsa(r %b)(s %b)))",
-                                  (int)sizeof (sig->r), sig->r,
-                                  (int)sizeof (sig->s), sig->s)))
-  {
-    LOG_GCRY (GNUNET_ERROR_TYPE_ERROR, "gcry_sexp_build", rc);
+  if (0 != gcry_sexp_build (&sig_sexpr, NULL,
+                            "(sig-val(eddsa(r %b)(s %b)))",
+                            (int)sizeof (sig->r), sig->r,
+                            (int)sizeof (sig->s), sig->s))
     return GNUNET_SYSERR;
-  }
   data = data_to_eddsa_value (validate);
-  if (0 != (rc = gcry_sexp_build (&pub_sexpr, NULL,
-                                  "(public-key(ecc(curve " CURVE ")(flags eddsa)(q %b)))",
-                                  (int)sizeof (pub->q_y), pub->q_y)))
+  if (NULL == (pub_sexpr = pub_sexp_get (eddsa_pub_cache,
+                                         pub->q_y,
+                                         GNUNET_YES)))
   {
     gcry_sexp_release (data);
     gcry_sexp_release (sig_sexpr);
     return GNUNET_SYSERR;
   }
   rc = gcry_pk_verify (sig_sexpr, data, pub_sexpr);
-  gcry_sexp_release (pub_sexpr);
+  pub_sexp_put (eddsa_pub_cache, pub->q_y, pub_sexpr);
   gcry_sexp_release (data);
   gcry_sexp_release (sig_sexpr);
   if (0 != rc)
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Verify signature.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @returns #GNUNET_OK if ok, #GNUNET_SYSERR if invalid
+ */
+int
+GNUNET_CRYPTO_eddsa_verify (uint32_t purpose,
+                            const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                            const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                            const struct GNUNET_CRYPTO_EddsaPublicKey *pub)
+{
+  if (GNUNET_OK !=
+      GNUNET_CRYPTO_eddsa_verify_nolog (purpose, validate, sig, pub))
   {
     LOG (GNUNET_ERROR_TYPE_INFO,
-         _("EdDSA signature verification failed at %s:%d: %s\n"), __FILE__,
-         __LINE__, gcry_strerror (rc));
+         _("EdDSA signature verification failed\n"));
     return GNUNET_SYSERR;
   }
   return GNUNET_OK;
 }
 
 
+/**
+ * Verify a batch of EdDSA signatures.  Does not log, so it can
+ * be used from the crypto offload pool.
+ *
+ * @param purpose what is the purpose that the signatures should have?
+ * @param count number of signatures to verify
+ * @param validate array of @a count blocks to validate
+ * @param sigs array of @a count signatures
+ * @param pubs array of @a count public keys of the signers
+ * @param results where to store #GNUNET_OK or #GNUNET_SYSERR for
+ *        each signature, can be NULL
+ * @return number of valid signatures
+ */
+unsigned int
+GNUNET_CRYPTO_eddsa_verify_batch (uint32_t purpose,
+                                  unsigned int count,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *const *validate,
+                                  const struct GNUNET_CRYPTO_EddsaSignature *sigs,
+                                  const struct GNUNET_CRYPTO_EddsaPublicKey *pubs,
+                                  int *results)
+{
+  unsigned int i;
+  unsigned int valid;
+  int ret;
+
+  valid = 0;
+  for (i = 0; i < count; i++)
+  {
+    ret = GNUNET_CRYPTO_eddsa_verify_nolog (purpose,
+                                            validate[i],
+                                            &sigs[i],
+                                            &pubs[i]);
+    if (GNUNET_OK == ret)
+      valid++;
+    if (NULL != results)
+      results[i] = ret;
+  }
+  return valid;
+}
+
+
 /**
  * Derive key material from a public and a private ECDHE key.
  *
@@ -1151,6 +1492,203 @@ GNUNET_CRYPTO_ecdsa_public_key_derive (const struct GNUNET_CRYPTO_EcdsaPublicKey
 }
 
 
+/**
+ * Number of bits of the scalar handled per table lookup in
+ * #GNUNET_CRYPTO_ecdsa_derive_context_public_key().
+ */
+#define DERIVE_WINDOW_BITS 4
+
+/**
+ * Number of multiples per window of the table of a derivation
+ * context (we do not store the zero multiple).
+ */
+#define DERIVE_WINDOW_SIZE ((1 << DERIVE_WINDOW_BITS) - 1)
+
+/**
+ * Number of windows needed to cover a 256-bit scalar.
+ */
+#define DERIVE_WINDOWS (256 / DERIVE_WINDOW_BITS)
+
+
+/**
+ * Context for deriving public keys for many labels from the same
+ * public key.
+ */
+struct GNUNET_CRYPTO_EcdsaDeriveContext
+{
+
+  /**
+   * The original public key.
+   */
+  struct GNUNET_CRYPTO_EcdsaPublicKey pub;
+
+  /**
+   * Context string for the HKDF of 'h'.
+   */
+  char *context;
+
+  /**
+   * Curve context.
+   */
+  gcry_ctx_t ctx;
+
+  /**
+   * Order of the curve.
+   */
+  gcry_mpi_t n;
+
+  /**
+   * Fixed-base table: @e table[i][j] is (j+1) * 16^i * Q, where Q is
+   * the point of @e pub.  A scalar multiplication then only needs
+   * one point addition per non-zero nibble of the scalar.
+   */
+  gcry_mpi_point_t table[DERIVE_WINDOWS][DERIVE_WINDOW_SIZE];
+};
+
+
+/**
+ * Create a context for deriving public keys from @a pub.  Creating
+ * the context precomputes a table of multiples of @a pub, which costs
+ * about as much as five calls to
+ * #GNUNET_CRYPTO_ecdsa_public_key_derive(); each derivation with the
+ * context is then several times faster than that function.  A context
+ * must not be used by several threads at once.
+ *
+ * @param pub original public key
+ * @param context additional context to use for HKDF of 'h'.
+ *        typically the name of the subsystem/application
+ * @return the derivation context
+ */
+struct GNUNET_CRYPTO_EcdsaDeriveContext *
+GNUNET_CRYPTO_ecdsa_derive_context_create (const struct GNUNET_CRYPTO_EcdsaPublicKey *pub,
+                                           const char *context)
+{
+  struct GNUNET_CRYPTO_EcdsaDeriveContext *dc;
+  gcry_mpi_t q_y;
+  gcry_mpi_point_t base;
+  unsigned int i;
+  unsigned int j;
+
+  dc = GNUNET_new (struct GNUNET_CRYPTO_EcdsaDeriveContext);
+  dc->pub = *pub;
+  dc->context = GNUNET_strdup (context);
+  GNUNET_assert (0 == gcry_mpi_ec_new (&dc->ctx, NULL, CURVE));
+  /* decompress the point once, see #GNUNET_CRYPTO_ecdsa_public_key_derive() */
+  q_y = gcry_mpi_set_opaque_copy (NULL, pub->q_y, 8*sizeof (pub->q_y));
+  GNUNET_assert (NULL != q_y);
+  GNUNET_assert (0 == gcry_mpi_ec_set_mpi ("q", q_y, dc->ctx));
+  gcry_mpi_release (q_y);
+  base = gcry_mpi_ec_get_point ("q", dc->ctx, 1);
+  GNUNET_assert (NULL != base);
+  dc->n = gcry_mpi_ec_get_mpi ("n", dc->ctx, 1);
+  for (i=0;i<DERIVE_WINDOWS;i++)
+  {
+    dc->table[i][0] = base;
+    for (j=1;j<DERIVE_WINDOW_SIZE;j++)
+    {
+      dc->table[i][j] = gcry_mpi_point_new (0);
+      gcry_mpi_ec_add (dc->table[i][j],
+                       dc->table[i][j - 1],
+                       base,
+                       dc->ctx);
+    }
+    if (i + 1 == DERIVE_WINDOWS)
+      break;
+    /* next base: 16^(i+1) * Q = 15 * 16^i * Q + 16^i * Q */
+    base = gcry_mpi_point_new (0);
+    gcry_mpi_ec_add (base,
+                     dc->table[i][DERIVE_WINDOW_SIZE - 1],
+                     dc->table[i][0],
+                     dc->ctx);
+  }
+  return dc;
+}
+
+
+/**
+ * Derive a public key for a label, like
+ * #GNUNET_CRYPTO_ecdsa_public_key_derive() does for the public key
+ * and context that @a dc was created with.
+ *
+ * @param dc derivation context
+ * @param label label to use for key deriviation
+ * @param result where to write the derived public key
+ */
+void
+GNUNET_CRYPTO_ecdsa_derive_context_public_key (struct GNUNET_CRYPTO_EcdsaDeriveContext *dc,
+                                               const char *label,
+                                               struct GNUNET_CRYPTO_EcdsaPublicKey *result)
+{
+  gcry_mpi_t h;
+  gcry_mpi_t h_mod_n;
+  gcry_mpi_t q_y;
+  gcry_mpi_point_t v;
+  gcry_mpi_point_t tmp;
+  gcry_mpi_point_t swap;
+  unsigned int i;
+  unsigned int b;
+  unsigned int nibble;
+
+  /* calculate h_mod_n = h % n */
+  h = derive_h (&dc->pub, label, dc->context);
+  h_mod_n = gcry_mpi_new (256);
+  gcry_mpi_mod (h_mod_n, h, dc->n);
+  gcry_mpi_release (h);
+  /* calculate v = h_mod_n * q, starting from the neutral element */
+  v = gcry_mpi_point_snatch_set (NULL,
+                                 gcry_mpi_set_ui (NULL, 0),
+                                 gcry_mpi_set_ui (NULL, 1),
+                                 gcry_mpi_set_ui (NULL, 1));
+  tmp = gcry_mpi_point_new (0);
+  for (i=0;i<DERIVE_WINDOWS;i++)
+  {
+    nibble = 0;
+    for (b=0;b<DERIVE_WINDOW_BITS;b++)
+      if (gcry_mpi_test_bit (h_mod_n, i * DERIVE_WINDOW_BITS + b))
+        nibble |= 1 << b;
+    if (0 == nibble)
+      continue;
+    gcry_mpi_ec_add (tmp, v, dc->table[i][nibble - 1], dc->ctx);
+    swap = v;
+    v = tmp;
+    tmp = swap;
+  }
+  gcry_mpi_point_release (tmp);
+  gcry_mpi_release (h_mod_n);
+
+  /* convert point 'v' to public key that we return */
+  GNUNET_assert (0 == gcry_mpi_ec_set_point ("q", v, dc->ctx));
+  gcry_mpi_point_release (v);
+  q_y = gcry_mpi_ec_get_mpi ("q@eddsa", dc->ctx, 0);
+  GNUNET_assert (q_y);
+  GNUNET_CRYPTO_mpi_print_unsigned (result->q_y,
+                                    sizeof (result->q_y),
+                                    q_y);
+  gcry_mpi_release (q_y);
+}
+
+
+/**
+ * Destroy a derivation context.
+ *
+ * @param dc context to destroy
+ */
+void
+GNUNET_CRYPTO_ecdsa_derive_context_destroy (struct GNUNET_CRYPTO_EcdsaDeriveContext *dc)
+{
+  unsigned int i;
+  unsigned int j;
+
+  for (i=0;i<DERIVE_WINDOWS;i++)
+    for (j=0;j<DERIVE_WINDOW_SIZE;j++)
+      gcry_mpi_point_release (dc->table[i][j]);
+  gcry_mpi_release (dc->n);
+  gcry_ctx_release (dc->ctx);
+  GNUNET_free (dc->context);
+  GNUNET_free (dc);
+}
+
+
 /**
  * Reverse the sequence of the bytes in @a buffer
  *
@@ -28,7 +28,11 @@
 #include "platform.h"
 #include <gcrypt.h>
 #include "gnunet_crypto_lib.h"
-#include "gnunet_container_lib.h"
+#include "gnunet_disk_lib.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
+
+#define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
 
 
 /**
@@ -41,23 +45,45 @@
 
 
 /**
- *
+ * Magic number identifying a dlog table file ("GDLT").
  */
-static void
-extract_pk (gcry_mpi_point_t pt,
-	      gcry_ctx_t ctx,
-	      struct GNUNET_PeerIdentity *pid)
+#define DLOG_TABLE_MAGIC 0x47444c54
+
+
+GNUNET_NETWORK_STRUCT_BEGIN
+
+/**
+ * Header of a serialized dlog table.  It is followed by the
+ * `2 * mem` points representing `i * K` for `i` from `-(mem - 1)` to
+ * `mem` (with `K = ceil (max / mem)`), and then by the `slot_count`
+ * slots of an open-addressed index over these points.  Each slot is
+ * a 32-bit value in NBO, zero for an empty slot and otherwise one
+ * plus the offset of the point.  All values are in NBO.
+ */
+struct DlogTableHeader
 {
-  gcry_mpi_t q_y;
-  
-  GNUNET_assert (0 == gcry_mpi_ec_set_point ("q", pt, ctx));
-  q_y = gcry_mpi_ec_get_mpi ("q@eddsa", ctx, 0);
-  GNUNET_assert (q_y);
-  GNUNET_CRYPTO_mpi_print_unsigned (pid->public_key.q_y,
-				    sizeof (pid->public_key.q_y),
-                                    q_y);
-  gcry_mpi_release (q_y);
-}
+  /**
+   * Always #DLOG_TABLE_MAGIC.
+   */
+  uint32_t magic GNUNET_PACKED;
+
+  /**
+   * Maximum absolute value the table supports.
+   */
+  uint32_t max GNUNET_PACKED;
+
+  /**
+   * Number of positive baby steps in the table.
+   */
+  uint32_t mem GNUNET_PACKED;
+
+  /**
+   * Number of slots in the index, a power of two.
+   */
+  uint32_t slot_count GNUNET_PACKED;
+};
+
+GNUNET_NETWORK_STRUCT_END
 
 
 /**
@@ -76,12 +102,45 @@ struct GNUNET_CRYPTO_EccDlogContext
   unsigned int mem;
 
   /**
-   * Map mapping points (here "interpreted" as EdDSA public keys) to
-   * a "void * = long" which corresponds to the numeric value of the
-   * point.  As NULL is used to represent "unknown", the actual value
-   * represented by the entry in the map is the "long" minus @e max.
+   * Serialized table, NULL if this context does not support dlog.
+   * Either points to @e table_mem or into the mapping @e mh.
+   */
+  const struct DlogTableHeader *table;
+
+  /**
+   * Points in @e table, `2 * mem` of them.
+   */
+  const struct GNUNET_CRYPTO_EccPoint *points;
+
+  /**
+   * Index in @e table, `slot_count` entries.
+   */
+  const uint32_t *slots;
+
+  /**
+   * Number of slots in @e slots minus one.
+   */
+  uint32_t slot_mask;
+
+  /**
+   * Size of @e table in bytes.
+   */
+  size_t table_size;
+
+  /**
+   * Heap-allocated table, NULL if @e table is mapped from a file.
+   */
+  struct DlogTableHeader *table_mem;
+
+  /**
+   * File @e table is mapped from, NULL if it is on the heap.
+   */
+  struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Mapping of @e fh.
    */
-  struct GNUNET_CONTAINER_MultiPeerMap *map;
+  struct GNUNET_DISK_MapHandle *mh;
 
   /**
    * Context to use for operations on the elliptic curve.
@@ -91,8 +150,109 @@ struct GNUNET_CRYPTO_EccDlogContext
 };
 
 
+/**
+ * Compute the number of slots of the index for a table with @a mem
+ * baby steps, keeping the load factor at most 1/2.
+ *
+ * @param mem number of positive baby steps
+ * @return number of slots, a power of two
+ */
+static uint32_t
+get_slot_count (unsigned int mem)
+{
+  uint32_t slot_count;
+
+  slot_count = 1;
+  while (slot_count < 4 * mem)
+    slot_count *= 2;
+  return slot_count;
+}
+
+
+/**
+ * Compute the total size of a table.
+ *
+ * @param mem number of positive baby steps
+ * @param slot_count number of slots in the index
+ * @return size in bytes
+ */
+static size_t
+get_table_size (unsigned int mem,
+                uint32_t slot_count)
+{
+  return sizeof (struct DlogTableHeader)
+    + 2 * (size_t) mem * sizeof (struct GNUNET_CRYPTO_EccPoint)
+    + (size_t) slot_count * sizeof (uint32_t);
+}
+
+
+/**
+ * Set up the pointers of @a edc into @a table.
+ *
+ * @param edc context to initialize
+ * @param table table to use
+ */
+static void
+setup_table (struct GNUNET_CRYPTO_EccDlogContext *edc,
+             const struct DlogTableHeader *table)
+{
+  edc->table = table;
+  edc->max = ntohl (table->max);
+  edc->mem = ntohl (table->mem);
+  edc->slot_mask = ntohl (table->slot_count) - 1;
+  edc->points = (const struct GNUNET_CRYPTO_EccPoint *) &table[1];
+  edc->slots = (const uint32_t *) &edc->points[2 * edc->mem];
+}
+
+
+/**
+ * Compute the first slot to probe for a point.  Encoded points are
+ * uniformly distributed, so we simply use their first bytes.
+ *
+ * @param edc context with the table
+ * @param point point to look for
+ * @return slot offset
+ */
+static uint32_t
+get_slot (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+          const struct GNUNET_CRYPTO_EccPoint *point)
+{
+  uint32_t h;
+
+  memcpy (&h, point->q_y, sizeof (h));
+  return h & edc->slot_mask;
+}
+
+
+/**
+ * Look up a point in the table.
+ *
+ * @param edc context with the table
+ * @param point point to look for
+ * @return offset of @a point in the table plus one, 0 if not found
+ */
+static uint32_t
+lookup_point (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+              const struct GNUNET_CRYPTO_EccPoint *point)
+{
+  uint32_t slot;
+  uint32_t off;
+
+  for (slot = get_slot (edc, point);
+       0 != (off = ntohl (edc->slots[slot]));
+       slot = (slot + 1) & edc->slot_mask)
+    if (0 == memcmp (&edc->points[off - 1],
+                     point,
+                     sizeof (struct GNUNET_CRYPTO_EccPoint)))
+      return off;
+  return 0;
+}
+
+
 /**
  * Do pre-calculation for ECC discrete logarithm for small factors.
+ * The table can be stored with #GNUNET_CRYPTO_ecc_dlog_write()
+ * and later be loaded using #GNUNET_CRYPTO_ecc_dlog_load().
  * 
  * @param max maximum value the factor can be
  * @param mem memory to use (should be smaller than @a max), must not be zero.
@@ -104,57 +264,215 @@ GNUNET_CRYPTO_ecc_dlog_prepare (unsigned int max,
 {
   struct GNUNET_CRYPTO_EccDlogContext *edc;
   unsigned int K = ((max + (mem-1)) / mem);
+  struct DlogTableHeader *table;
+  struct GNUNET_CRYPTO_EccPoint *points;
+  uint32_t *slots;
+  uint32_t slot_count;
   gcry_mpi_point_t g;
-  struct GNUNET_PeerIdentity key;
+  gcry_mpi_point_t gK;
   gcry_mpi_point_t gKi;
   gcry_mpi_t fact;
   gcry_mpi_t n;
+  uint32_t slot;
   unsigned int i;
 
   GNUNET_assert (max < INT32_MAX);
+  GNUNET_assert (mem < INT32_MAX / 4);
   edc = GNUNET_new (struct GNUNET_CRYPTO_EccDlogContext);
-  edc->max = max;
-  edc->mem = mem;
-
-  edc->map = GNUNET_CONTAINER_multipeermap_create (mem * 2,
-						   GNUNET_NO);
-
   GNUNET_assert (0 == gcry_mpi_ec_new (&edc->ctx, 
 				       NULL, 
 				       CURVE));
+  slot_count = get_slot_count (mem);
+  edc->table_size = get_table_size (mem,
+                                    slot_count);
+  table = GNUNET_malloc_large (edc->table_size);
+  GNUNET_assert (NULL != table);
+  edc->table_mem = table;
+  table->magic = htonl (DLOG_TABLE_MAGIC);
+  table->max = htonl (max);
+  table->mem = htonl (mem);
+  table->slot_count = htonl (slot_count);
+  setup_table (edc,
+               table);
+  points = (struct GNUNET_CRYPTO_EccPoint *) edc->points;
+  slots = (uint32_t *) edc->slots;
+
+  /* The point for i * K is at offset i + mem - 1.  We walk from
+     0 upwards and from -K downwards using additions only. */
   g = gcry_mpi_ec_get_point ("g", edc->ctx, 0);
   GNUNET_assert (NULL != g);
   fact = gcry_mpi_new (0);
+  gK = gcry_mpi_point_new (0);
   gKi = gcry_mpi_point_new (0);
+  gcry_mpi_set_ui (fact, K);
+  gcry_mpi_ec_mul (gK, fact, g, edc->ctx);
+  gcry_mpi_set_ui (fact, 0);
+  gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
   for (i=0;i<=mem;i++)
   {
-    gcry_mpi_set_ui (fact, i * K);
-    gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
-    extract_pk (gKi, edc->ctx, &key);
-    GNUNET_assert (GNUNET_OK ==
-		   GNUNET_CONTAINER_multipeermap_put (edc->map,
-						      &key,
-						      (void*) (long) i + max,
-						      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    GNUNET_CRYPTO_ecc_point_to_bin (edc,
+                                    gKi,
+                                    &points[i + mem - 1]);
+    gcry_mpi_ec_add (gKi, gKi, gK, edc->ctx);
   }
   /* negative values */
   n = gcry_mpi_ec_get_mpi ("n", edc->ctx, 1);
+  gcry_mpi_set_ui (fact, K);
+  gcry_mpi_sub (fact, n, fact);
+  gcry_mpi_ec_mul (gK, fact, g, edc->ctx);
+  gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
   for (i=1;i<mem;i++)
   {
-    gcry_mpi_set_ui (fact, i * K);
-    gcry_mpi_sub (fact, n, fact);
-    gcry_mpi_ec_mul (gKi, fact, g, edc->ctx);
-    extract_pk (gKi, edc->ctx, &key);
-    GNUNET_assert (GNUNET_OK ==
-		   GNUNET_CONTAINER_multipeermap_put (edc->map,
-						      &key,
-						      (void*) (long) max - i,
-						      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+    GNUNET_CRYPTO_ecc_point_to_bin (edc,
+                                    gKi,
+                                    &points[mem - 1 - i]);
+    gcry_mpi_ec_add (gKi, gKi, gK, edc->ctx);
   }
   gcry_mpi_release (fact);
   gcry_mpi_release (n);
+  gcry_mpi_point_release (gK);
   gcry_mpi_point_release (gKi);
   gcry_mpi_point_release (g);
+
+  /* build the index */
+  for (i=0;i<2 * mem;i++)
+  {
+    GNUNET_assert (0 == lookup_point (edc,
+                                      &points[i]));
+    for (slot = get_slot (edc, &points[i]);
+         0 != slots[slot];
+         slot = (slot + 1) & edc->slot_mask) ;
+    slots[slot] = htonl (i + 1);
+  }
+  return edc;
+}
+
+
+/**
+ * Store the pre-calculated values of @a edc in a file, so that they
+ * can be loaded quickly and shared between processes using
+ * #GNUNET_CRYPTO_ecc_dlog_load().
+ *
+ * @param edc context created with #GNUNET_CRYPTO_ecc_dlog_prepare()
+ * @param filename where to store the table
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_CRYPTO_ecc_dlog_write (const struct GNUNET_CRYPTO_EccDlogContext *edc,
+                              const char *filename)
+{
+  char *tmp;
+  int ret;
+
+  if (NULL == edc->table)
+  {
+    GNUNET_break (0);
+    return GNUNET_SYSERR;
+  }
+  if (GNUNET_OK !=
+      GNUNET_DISK_directory_create_for_file (filename))
+    return GNUNET_SYSERR;
+  /* write to a temporary file first, so that concurrent readers never
+     see a partial table */
+  GNUNET_asprintf (&tmp,
+                   "%s.%u",
+                   filename,
+                   (unsigned int) getpid ());
+  ret = GNUNET_OK;
+  if (edc->table_size !=
+      GNUNET_DISK_fn_write (tmp,
+                            edc->table,
+                            edc->table_size,
+                            GNUNET_DISK_PERM_USER_READ
+                            | GNUNET_DISK_PERM_USER_WRITE
+                            | GNUNET_DISK_PERM_GROUP_READ
+                            | GNUNET_DISK_PERM_OTHER_READ))
+    ret = GNUNET_SYSERR;
+  if ( (GNUNET_OK == ret) &&
+       (0 != rename (tmp,
+                     filename)) )
+  {
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING,
+                       "rename",
+                       filename);
+    ret = GNUNET_SYSERR;
+  }
+  if (GNUNET_OK != ret)
+    (void) UNLINK (tmp);
+  GNUNET_free (tmp);
+  return ret;
+}
+
+
+/**
+ * Load pre-calculated values for ECC discrete logarithm from a file
+ * written by #GNUNET_CRYPTO_ecc_dlog_write().  The file is mapped
+ * read-only, so that processes using the same table share the memory.
+ *
+ * @param filename file with the table
+ * @param max maximum value the factor can be, must match the table
+ * @param mem memory to use, must match the table
+ * @return NULL if the file does not exist or does not match
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_dlog_load (const char *filename,
+                             unsigned int max,
+                             unsigned int mem)
+{
+  struct GNUNET_CRYPTO_EccDlogContext *edc;
+  const struct DlogTableHeader *table;
+  uint32_t slot_count;
+  off_t fsize;
+
+  if (GNUNET_YES !=
+      GNUNET_DISK_file_test (filename))
+    return NULL;
+  edc = GNUNET_new (struct GNUNET_CRYPTO_EccDlogContext);
+  slot_count = get_slot_count (mem);
+  edc->table_size = get_table_size (mem,
+                                    slot_count);
+  edc->fh = GNUNET_DISK_file_open (filename,
+                                   GNUNET_DISK_OPEN_READ,
+                                   GNUNET_DISK_PERM_NONE);
+  if (NULL == edc->fh)
+  {
+    GNUNET_free (edc);
+    return NULL;
+  }
+  if ( (GNUNET_OK !=
+        GNUNET_DISK_file_handle_size (edc->fh,
+                                      &fsize)) ||
+       (fsize != (off_t) edc->table_size) ||
+       (NULL == (table = GNUNET_DISK_file_map (edc->fh,
+                                               &edc->mh,
+                                               GNUNET_DISK_MAP_TYPE_READ,
+                                               edc->table_size))) )
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Dlog table `%s' has the wrong size, ignoring it\n",
+         filename);
+    GNUNET_DISK_file_close (edc->fh);
+    GNUNET_free (edc);
+    return NULL;
+  }
+  if ( (DLOG_TABLE_MAGIC != ntohl (table->magic)) ||
+       (max != ntohl (table->max)) ||
+       (mem != ntohl (table->mem)) ||
+       (slot_count != ntohl (table->slot_count)) )
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         "Dlog table `%s' does not match the requested parameters, ignoring it\n",
+         filename);
+    GNUNET_DISK_file_unmap (edc->mh);
+    GNUNET_DISK_file_close (edc->fh);
+    GNUNET_free (edc);
+    return NULL;
+  }
+  GNUNET_assert (0 == gcry_mpi_ec_new (&edc->ctx,
+                                       NULL,
+                                       CURVE));
+  setup_table (edc,
+               table);
   return edc;
 }
 
@@ -172,12 +490,13 @@ GNUNET_CRYPTO_ecc_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
 {
   unsigned int K = ((edc->max + (edc->mem-1)) / edc->mem);
   gcry_mpi_point_t g;
-  struct GNUNET_PeerIdentity key;
+  struct GNUNET_CRYPTO_EccPoint key;
   gcry_mpi_point_t q;
   unsigned int i;
   int res;
-  void *retp;
+  uint32_t off;
 
+  GNUNET_assert (NULL != edc->table);
   g = gcry_mpi_ec_get_point ("g", edc->ctx, 0);
   GNUNET_assert (NULL != g);
   q = gcry_mpi_point_new (0);
@@ -186,14 +505,14 @@ GNUNET_CRYPTO_ecc_dlog (struct GNUNET_CRYPTO_EccDlogContext *edc,
   for (i=0;i<=edc->max/edc->mem;i++)
   {
     if (0 == i)
-      extract_pk (input, edc->ctx, &key);
+      GNUNET_CRYPTO_ecc_point_to_bin (edc, input, &key);
     else
-      extract_pk (q, edc->ctx, &key);
-    retp = GNUNET_CONTAINER_multipeermap_get (edc->map,
-					      &key);
-    if (NULL != retp)
+      GNUNET_CRYPTO_ecc_point_to_bin (edc, q, &key);
+    off = lookup_point (edc,
+                        &key);
+    if (0 != off)
     {
-      res = (((long) retp) - edc->max) * K - i;
+      res = ((int) off - (int) edc->mem) * (int) K - (int) i;
       /* we continue the loop here to make the implementation
 	 "constant-time". If we do not care about this, we could just
 	 'break' here and do fewer operations... */
@@ -247,6 +566,88 @@ GNUNET_CRYPTO_ecc_random_mod_n (struct GNUNET_CRYPTO_EccDlogContext *edc)
 }
 
 
+/**
+ * Create a context for ECC additions and multiplications that does
+ * not support #GNUNET_CRYPTO_ecc_dlog().  Creating such a context is
+ * cheap.  As contexts must not be shared between threads, this is
+ * what worker threads should use.
+ *
+ * @return NULL on error
+ */
+struct GNUNET_CRYPTO_EccDlogContext *
+GNUNET_CRYPTO_ecc_context_create ()
+{
+  struct GNUNET_CRYPTO_EccDlogContext *edc;
+
+  edc = GNUNET_new (struct GNUNET_CRYPTO_EccDlogContext);
+  if (0 != gcry_mpi_ec_new (&edc->ctx,
+                            NULL,
+                            CURVE))
+  {
+    GNUNET_free (edc);
+    return NULL;
+  }
+  return edc;
+}
+
+
+/**
+ * Convert point value to binary representation.
+ *
+ * @param edc calculation context for ECC operations
+ * @param point computational point representation
+ * @param[out] bin binary point representation
+ */
+void
+GNUNET_CRYPTO_ecc_point_to_bin (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                                gcry_mpi_point_t point,
+                                struct GNUNET_CRYPTO_EccPoint *bin)
+{
+  gcry_mpi_t q_y;
+
+  GNUNET_assert (0 == gcry_mpi_ec_set_point ("q", point, edc->ctx));
+  q_y = gcry_mpi_ec_get_mpi ("q@eddsa", edc->ctx, 0);
+  GNUNET_assert (q_y);
+  GNUNET_CRYPTO_mpi_print_unsigned (bin->q_y,
+                                    sizeof (bin->q_y),
+                                    q_y);
+  gcry_mpi_release (q_y);
+}
+
+
+/**
+ * Convert binary representation of a point to computational representation.
+ *
+ * @param edc calculation context for ECC operations
+ * @param bin binary point representation
+ * @return computational representation, NULL if @a bin is not a
+ *         valid point; must be freed using #GNUNET_CRYPTO_ecc_free()
+ */
+gcry_mpi_point_t
+GNUNET_CRYPTO_ecc_bin_to_point (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                                const struct GNUNET_CRYPTO_EccPoint *bin)
+{
+  gcry_sexp_t pub_sexpr;
+  gcry_ctx_t ctx;
+  gcry_mpi_point_t q;
+
+  if (0 != gcry_sexp_build (&pub_sexpr, NULL,
+                            "(public-key(ecc(curve " CURVE ")(q %b)))",
+                            (int) sizeof (bin->q_y),
+                            bin->q_y))
+    return NULL;
+  if (0 != gcry_mpi_ec_new (&ctx, pub_sexpr, NULL))
+  {
+    gcry_sexp_release (pub_sexpr);
+    return NULL;
+  }
+  gcry_sexp_release (pub_sexpr);
+  q = gcry_mpi_ec_get_point ("q", ctx, 0);
+  gcry_ctx_release (ctx);
+  return q;
+}
+
+
 /**
  * Release precalculated values.
  *
@@ -256,7 +657,11 @@ void
 GNUNET_CRYPTO_ecc_dlog_release (struct GNUNET_CRYPTO_EccDlogContext *edc)
 {
   gcry_ctx_release (edc->ctx);
-  GNUNET_CONTAINER_multipeermap_destroy (edc->map);
+  if (NULL != edc->mh)
+    GNUNET_DISK_file_unmap (edc->mh);
+  if (NULL != edc->fh)
+    GNUNET_DISK_file_close (edc->fh);
+  GNUNET_free_non_null (edc->table_mem);
   GNUNET_free (edc);
 }
 
@@ -330,6 +735,40 @@ GNUNET_CRYPTO_ecc_dexp_mpi (struct GNUNET_CRYPTO_EccDlogContext *edc,
 }
 
 
+/**
+ * Multiply the point @a p on the elliptic curve by @a val.
+ *
+ * @param edc calculation context for ECC operations
+ * @param p point to multiply
+ * @param val value to multiply @a p by, may be negative
+ * @return @a p * @a val, must be freed using #GNUNET_CRYPTO_ecc_free()
+ */
+gcry_mpi_point_t
+GNUNET_CRYPTO_ecc_pmul_mpi (struct GNUNET_CRYPTO_EccDlogContext *edc,
+                            gcry_mpi_point_t p,
+                            gcry_mpi_t val)
+{
+  gcry_mpi_point_t r;
+  gcry_mpi_t n;
+  gcry_mpi_t fact;
+
+  r = gcry_mpi_point_new (0);
+  if (! gcry_mpi_is_neg (val))
+  {
+    gcry_mpi_ec_mul (r, val, p, edc->ctx);
+    return r;
+  }
+  /* negative factor: multiply by val mod n instead */
+  n = gcry_mpi_ec_get_mpi ("n", edc->ctx, 1);
+  fact = gcry_mpi_new (0);
+  gcry_mpi_mod (fact, val, n);
+  gcry_mpi_ec_mul (r, fact, p, edc->ctx);
+  gcry_mpi_release (fact);
+  gcry_mpi_release (n);
+  return r;
+}
+
+
 /**
  * Add two points on the elliptic curve.
  * 
@@ -27,6 +27,9 @@
 #include "gnunet_crypto_lib.h"
 #include "gnunet_strings_lib.h"
 #include <gcrypt.h>
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
@@ -48,6 +51,162 @@ GNUNET_CRYPTO_hash (const void *block,
 }
 
 
+/**
+ * Below how many bytes in total do we hash in the calling
+ * thread only?
+ */
+#define HASH_MANY_THREAD_THRESHOLD (64 * 1024)
+
+/**
+ * Maximum number of threads (including the caller) used by
+ * #GNUNET_CRYPTO_hash_many().
+ */
+#define HASH_MANY_MAX_THREADS 8
+
+
+/**
+ * Share of the work of #GNUNET_CRYPTO_hash_many().
+ */
+struct HashManyContext
+{
+  /**
+   * Blocks to hash.
+   */
+  const void *const *blocks;
+
+  /**
+   * Sizes of the @e blocks.
+   */
+  const size_t *sizes;
+
+  /**
+   * Where to write the results.
+   */
+  struct GNUNET_HashCode *ret;
+
+  /**
+   * Index of the first block of this share.
+   */
+  unsigned int start;
+
+  /**
+   * Index after the last block of this share.
+   */
+  unsigned int end;
+};
+
+
+/**
+ * Hash the blocks of one share.
+ *
+ * @param cls the `struct HashManyContext`
+ * @return NULL
+ */
+static void *
+hash_share (void *cls)
+{
+  struct HashManyContext *ctx = cls;
+  unsigned int i;
+
+  for (i = ctx->start; i < ctx->end; i++)
+    gcry_md_hash_buffer (GCRY_MD_SHA512, &ctx->ret[i],
+                         ctx->blocks[i], ctx->sizes[i]);
+  return NULL;
+}
+
+
+/**
+ * Hash many independent blocks.  The results are the same as
+ * calling #GNUNET_CRYPTO_hash() on each block.  If there is enough
+ * data, the blocks are hashed by several threads in parallel.
+ *
+ * @param blocks the blocks to hash
+ * @param sizes sizes of the @a blocks
+ * @param n number of blocks
+ * @param ret array of @a n hash codes to write the results to
+ */
+void
+GNUNET_CRYPTO_hash_many (const void *const *blocks,
+                         const size_t *sizes,
+                         unsigned int n,
+                         struct GNUNET_HashCode *ret)
+{
+  struct HashManyContext ctx[HASH_MANY_MAX_THREADS];
+  unsigned int threads;
+  unsigned int i;
+#if HAVE_PTHREAD
+  pthread_t tid[HASH_MANY_MAX_THREADS];
+  size_t total;
+  size_t share;
+  size_t acc;
+  unsigned int started;
+  long cpus;
+#endif
+
+  threads = 1;
+#if HAVE_PTHREAD
+  total = 0;
+  for (i = 0; i < n; i++)
+    total += sizes[i];
+#ifdef _SC_NPROCESSORS_ONLN
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if ( (total >= HASH_MANY_THREAD_THRESHOLD) &&
+       (cpus > 1) )
+    threads = GNUNET_MIN (GNUNET_MIN ((unsigned int) cpus, n),
+                          HASH_MANY_MAX_THREADS);
+#endif
+#endif
+  if (1 == threads)
+  {
+    ctx[0].blocks = blocks;
+    ctx[0].sizes = sizes;
+    ctx[0].ret = ret;
+    ctx[0].start = 0;
+    ctx[0].end = n;
+    (void) hash_share (&ctx[0]);
+    return;
+  }
+#if HAVE_PTHREAD
+  /* split into shares of about the same number of bytes */
+  share = total / threads;
+  acc = 0;
+  ctx[0].start = 0;
+  threads = 0;
+  for (i = 0; i < n; i++)
+  {
+    acc += sizes[i];
+    if ( (acc >= share) &&
+         (threads + 1 < HASH_MANY_MAX_THREADS) &&
+         (i + 1 < n) )
+    {
+      ctx[threads].end = i + 1;
+      threads++;
+      ctx[threads].start = i + 1;
+      acc = 0;
+    }
+  }
+  ctx[threads].end = n;
+  threads++;
+  for (i = 0; i < threads; i++)
+  {
+    ctx[i].blocks = blocks;
+    ctx[i].sizes = sizes;
+    ctx[i].ret = ret;
+  }
+  /* the caller hashes the first share itself */
+  for (started = 1; started < threads; started++)
+    if (0 != pthread_create (&tid[started], NULL, &hash_share, &ctx[started]))
+      break;
+  (void) hash_share (&ctx[0]);
+  for (i = 1; i < started; i++)
+    GNUNET_break (0 == pthread_join (tid[i], NULL));
+  /* shares we could not start a thread for */
+  for (i = started; i < threads; i++)
+    (void) hash_share (&ctx[i]);
+#endif
+}
+
+
 /* ***************** binary-ASCII encoding *************** */
 
 
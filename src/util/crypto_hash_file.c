@@ -31,6 +31,12 @@
 
 #define LOG_STRERROR_FILE(kind,syscall,filename) GNUNET_log_from_strerror_file (kind, "util", syscall, filename)
 
+/**
+ * How many bytes does one offloaded job hash before returning
+ * to the scheduler?
+ */
+#define OFFLOAD_CHUNK (8 * 1024 * 1024)
+
 
 /**
  * Context used when hashing a file.
@@ -83,6 +89,11 @@ struct GNUNET_CRYPTO_FileHashContext
    */
   struct GNUNET_SCHEDULER_Task * task;
 
+  /**
+   * Current offloaded job, if we hash in the offload pool.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
   /**
    * Priority we use.
    */
@@ -93,18 +104,22 @@ struct GNUNET_CRYPTO_FileHashContext
    */
   size_t bsize;
 
+  /**
+   * errno of the failed read in an offloaded job.
+   */
+  int read_errno;
+
 };
 
 
 /**
- * Report result of hash computation to callback
- * and free associated resources.
+ * Release the resources of a file hashing operation.
+ *
+ * @param fhc operation to clean up
  */
 static void
-file_hash_finish (struct GNUNET_CRYPTO_FileHashContext *fhc,
-                  const struct GNUNET_HashCode * res)
+file_hash_destroy (struct GNUNET_CRYPTO_FileHashContext *fhc)
 {
-  fhc->callback (fhc->callback_cls, res);
   GNUNET_free (fhc->filename);
   if (!GNUNET_DISK_handle_invalid (fhc->fh))
     GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fhc->fh));
@@ -113,6 +128,19 @@ file_hash_finish (struct GNUNET_CRYPTO_FileHashContext *fhc,
 }
 
 
+/**
+ * Report result of hash computation to callback
+ * and free associated resources.
+ */
+static void
+file_hash_finish (struct GNUNET_CRYPTO_FileHashContext *fhc,
+                  const struct GNUNET_HashCode * res)
+{
+  fhc->callback (fhc->callback_cls, res);
+  file_hash_destroy (fhc);
+}
+
+
 /**
  * File hashing task.
  *
@@ -151,20 +179,92 @@ file_hash_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 
 
 /**
- * Compute the hash of an entire file.
+ * Hash the next #OFFLOAD_CHUNK bytes of the file.  Runs in a
+ * worker of the crypto offload pool, so it must not log.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_FileHashContext`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR on read errors
+ */
+static int
+file_hash_chunk (void *cls)
+{
+  struct GNUNET_CRYPTO_FileHashContext *fhc = cls;
+  uint64_t end;
+  size_t delta;
+
+  end = fhc->offset + GNUNET_MIN (fhc->fsize - fhc->offset,
+                                  OFFLOAD_CHUNK);
+#if HAVE_POSIX_FADVISE && defined(POSIX_FADV_WILLNEED) && !WINDOWS
+  /* let the kernel fetch the next chunk while we hash this one */
+  if (end < fhc->fsize)
+    (void) posix_fadvise (fhc->fh->fd,
+                          (off_t) end,
+                          (off_t) OFFLOAD_CHUNK,
+                          POSIX_FADV_WILLNEED);
+#endif
+  while (fhc->offset < end)
+  {
+    delta = fhc->bsize;
+    if (end - fhc->offset < delta)
+      delta = end - fhc->offset;
+    if (delta != GNUNET_DISK_file_read (fhc->fh, fhc->buffer, delta))
+    {
+      fhc->read_errno = errno;
+      return GNUNET_SYSERR;
+    }
+    gcry_md_write (fhc->md, fhc->buffer, delta);
+    fhc->offset += delta;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * An offloaded chunk was hashed.  Queue the next one or report
+ * the result.
+ *
+ * @param cls the `struct GNUNET_CRYPTO_FileHashContext`
+ * @param result result of #file_hash_chunk()
+ */
+static void
+file_hash_chunk_done (void *cls,
+                      int result)
+{
+  struct GNUNET_CRYPTO_FileHashContext *fhc = cls;
+  struct GNUNET_HashCode *res;
+
+  fhc->job = NULL;
+  if (GNUNET_OK != result)
+  {
+    errno = fhc->read_errno;
+    LOG_STRERROR_FILE (GNUNET_ERROR_TYPE_WARNING, "read", fhc->filename);
+    file_hash_finish (fhc, NULL);
+    return;
+  }
+  if (fhc->offset == fhc->fsize)
+  {
+    res = (struct GNUNET_HashCode *) gcry_md_read (fhc->md, GCRY_MD_SHA512);
+    file_hash_finish (fhc, res);
+    return;
+  }
+  fhc->job = GNUNET_CRYPTO_offload (&file_hash_chunk, fhc,
+                                    &file_hash_chunk_done, fhc);
+}
+
+
+/**
+ * Set up the context for hashing a file.
  *
- * @param priority scheduling priority to use
  * @param filename name of file to hash
- * @param blocksize number of bytes to process in one task
+ * @param blocksize number of bytes to read at once
  * @param callback function to call upon completion
  * @param callback_cls closure for callback
  * @return NULL on (immediate) errror
  */
-struct GNUNET_CRYPTO_FileHashContext *
-GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
-                         const char *filename, size_t blocksize,
-                         GNUNET_CRYPTO_HashCompletedCallback callback,
-                         void *callback_cls)
+static struct GNUNET_CRYPTO_FileHashContext *
+file_hash_create (const char *filename, size_t blocksize,
+                  GNUNET_CRYPTO_HashCompletedCallback callback,
+                  void *callback_cls)
 {
   struct GNUNET_CRYPTO_FileHashContext *fhc;
 
@@ -178,12 +278,14 @@ GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
   if (GPG_ERR_NO_ERROR != gcry_md_open (&fhc->md, GCRY_MD_SHA512, 0))
   {
     GNUNET_break (0);
+    GNUNET_free (fhc->filename);
     GNUNET_free (fhc);
     return NULL;
   }
   fhc->bsize = blocksize;
   if (GNUNET_OK != GNUNET_DISK_file_size (filename, &fhc->fsize, GNUNET_NO, GNUNET_YES))
   {
+    gcry_md_close (fhc->md);
     GNUNET_free (fhc->filename);
     GNUNET_free (fhc);
     return NULL;
@@ -193,10 +295,39 @@ GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
                              GNUNET_DISK_PERM_NONE);
   if (!fhc->fh)
   {
+    gcry_md_close (fhc->md);
     GNUNET_free (fhc->filename);
     GNUNET_free (fhc);
     return NULL;
   }
+#if HAVE_POSIX_FADVISE && defined(POSIX_FADV_SEQUENTIAL) && !WINDOWS
+  (void) posix_fadvise (fhc->fh->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  return fhc;
+}
+
+
+/**
+ * Compute the hash of an entire file.
+ *
+ * @param priority scheduling priority to use
+ * @param filename name of file to hash
+ * @param blocksize number of bytes to process in one task
+ * @param callback function to call upon completion
+ * @param callback_cls closure for callback
+ * @return NULL on (immediate) errror
+ */
+struct GNUNET_CRYPTO_FileHashContext *
+GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
+                         const char *filename, size_t blocksize,
+                         GNUNET_CRYPTO_HashCompletedCallback callback,
+                         void *callback_cls)
+{
+  struct GNUNET_CRYPTO_FileHashContext *fhc;
+
+  fhc = file_hash_create (filename, blocksize, callback, callback_cls);
+  if (NULL == fhc)
+    return NULL;
   fhc->priority = priority;
   fhc->task =
       GNUNET_SCHEDULER_add_with_priority (priority, &file_hash_task, fhc);
@@ -204,6 +335,34 @@ GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
 }
 
 
+/**
+ * Compute the hash of an entire file in the crypto offload pool.
+ * Reading and hashing happen in a worker thread, in chunks of
+ * #OFFLOAD_CHUNK bytes; the main loop only sees one continuation
+ * per chunk and the final @a callback.
+ *
+ * @param filename name of file to hash
+ * @param blocksize number of bytes to read at once
+ * @param callback function to call upon completion
+ * @param callback_cls closure for callback
+ * @return NULL on (immediate) errror
+ */
+struct GNUNET_CRYPTO_FileHashContext *
+GNUNET_CRYPTO_hash_file_offload (const char *filename, size_t blocksize,
+                                 GNUNET_CRYPTO_HashCompletedCallback callback,
+                                 void *callback_cls)
+{
+  struct GNUNET_CRYPTO_FileHashContext *fhc;
+
+  fhc = file_hash_create (filename, blocksize, callback, callback_cls);
+  if (NULL == fhc)
+    return NULL;
+  fhc->job = GNUNET_CRYPTO_offload (&file_hash_chunk, fhc,
+                                    &file_hash_chunk_done, fhc);
+  return fhc;
+}
+
+
 /**
  * Cancel a file hashing operation.
  *
@@ -212,10 +371,11 @@ GNUNET_CRYPTO_hash_file (enum GNUNET_SCHEDULER_Priority priority,
 void
 GNUNET_CRYPTO_hash_file_cancel (struct GNUNET_CRYPTO_FileHashContext *fhc)
 {
-  GNUNET_SCHEDULER_cancel (fhc->task);
-  GNUNET_free (fhc->filename);
-  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (fhc->fh));
-  GNUNET_free (fhc);
+  if (NULL != fhc->job)
+    GNUNET_CRYPTO_offload_cancel (fhc->job);
+  if (NULL != fhc->task)
+    GNUNET_SCHEDULER_cancel (fhc->task);
+  file_hash_destroy (fhc);
 }
 
 /* end of crypto_hash_file.c */
@@ -0,0 +1,817 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file util/crypto_offload.c
+ * @brief pool of worker threads for expensive cryptographic operations
+ *
+ * Jobs are queued for the workers; finished jobs are put into a
+ * second queue and the main loop is woken up via a pipe, so that the
+ * continuations run as ordinary scheduler tasks.
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#if HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-crypto-offload", __VA_ARGS__)
+
+#define LOG_STRERROR(kind,syscall) GNUNET_log_from_strerror (kind, "util-crypto-offload", syscall)
+
+/**
+ * Maximum number of worker threads.
+ */
+#define MAX_WORKERS 8
+
+
+/**
+ * State of an offloaded job.
+ */
+enum JobState
+{
+  /**
+   * Waiting for a worker.
+   */
+  JOB_PENDING,
+
+  /**
+   * A worker is running the job.
+   */
+  JOB_RUNNING,
+
+  /**
+   * Result is waiting for the main loop.
+   */
+  JOB_DONE
+};
+
+
+/**
+ * Handle for a job running in the crypto offload pool.
+ */
+struct GNUNET_CRYPTO_OffloadJob
+{
+  /**
+   * Kept in a DLL.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *next;
+
+  /**
+   * Kept in a DLL.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *prev;
+
+  /**
+   * Function to run in the worker.
+   */
+  GNUNET_CRYPTO_OffloadFunction work;
+
+  /**
+   * Closure for @e work.
+   */
+  void *work_cls;
+
+  /**
+   * Function to call with the result.
+   */
+  GNUNET_CRYPTO_OffloadContinuation cont;
+
+  /**
+   * Closure for @e cont.
+   */
+  void *cont_cls;
+
+  /**
+   * Memory owned by the job (arguments of the typed helpers),
+   * freed together with the job.  Can be NULL.
+   */
+  void *owned;
+
+  /**
+   * Result of @e work.
+   */
+  int result;
+
+  /**
+   * State of the job, protected by #lock.
+   */
+  enum JobState state;
+};
+
+
+/**
+ * Arguments and result of the typed helpers.
+ */
+struct TypedJob
+{
+  /**
+   * Continuation of the user.
+   */
+  union
+  {
+    GNUNET_CRYPTO_OffloadContinuation verify;
+    GNUNET_CRYPTO_EddsaSignContinuation sign;
+    GNUNET_CRYPTO_EcdhContinuation ecdh;
+  } cont;
+
+  /**
+   * Closure for @e cont.
+   */
+  void *cont_cls;
+
+  /**
+   * Block to sign or verify, allocated after this struct.
+   */
+  struct GNUNET_CRYPTO_EccSignaturePurpose *purpose;
+
+  /**
+   * Expected purpose for verification.
+   */
+  uint32_t purpose_type;
+
+  /**
+   * Public key for verification and ECDH.
+   */
+  union
+  {
+    struct GNUNET_CRYPTO_EddsaPublicKey eddsa;
+    struct GNUNET_CRYPTO_EcdsaPublicKey ecdsa;
+    struct GNUNET_CRYPTO_EcdhePublicKey ecdhe;
+  } pub;
+
+  /**
+   * Private key for signing and ECDH.
+   */
+  union
+  {
+    struct GNUNET_CRYPTO_EddsaPrivateKey eddsa;
+    struct GNUNET_CRYPTO_EcdhePrivateKey ecdhe;
+  } priv;
+
+  /**
+   * Signature to verify, or the signature we created.
+   */
+  union
+  {
+    struct GNUNET_CRYPTO_EddsaSignature eddsa;
+    struct GNUNET_CRYPTO_EcdsaSignature ecdsa;
+  } sig;
+
+  /**
+   * Result of the ECDH.
+   */
+  struct GNUNET_HashCode key_material;
+};
+
+
+/**
+ * Jobs waiting for a worker.
+ */
+static struct GNUNET_CRYPTO_OffloadJob *pending_head;
+
+/**
+ * Jobs waiting for a worker.
+ */
+static struct GNUNET_CRYPTO_OffloadJob *pending_tail;
+
+/**
+ * Jobs waiting for the main loop.
+ */
+static struct GNUNET_CRYPTO_OffloadJob *done_head;
+
+/**
+ * Jobs waiting for the main loop.
+ */
+static struct GNUNET_CRYPTO_OffloadJob *done_tail;
+
+/**
+ * Pipe used by the workers to wake up the main loop.
+ */
+static struct GNUNET_DISK_PipeHandle *wakeup_pipe;
+
+/**
+ * Task waiting for the #wakeup_pipe.
+ */
+static struct GNUNET_SCHEDULER_Task *wakeup_task;
+
+/**
+ * Number of jobs whose continuation was not called yet (and which
+ * were not cancelled).  Only used by the main loop.
+ */
+static unsigned int jobs_outstanding;
+
+#if HAVE_PTHREAD
+/**
+ * Protects the job queues and job states.
+ */
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when a job is queued for the workers.
+ */
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Signalled when a worker finished a job.
+ */
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Number of worker threads we started.
+ */
+static unsigned int num_workers;
+
+#define LOCK() GNUNET_assert (0 == pthread_mutex_lock (&lock))
+#define UNLOCK() GNUNET_assert (0 == pthread_mutex_unlock (&lock))
+#else
+#define LOCK() do {} while (0)
+#define UNLOCK() do {} while (0)
+#endif
+
+
+/**
+ * Move a job that was run to the queue for the main loop and wake up
+ * the main loop if needed.  Must be called with #lock held.
+ *
+ * @param job the job
+ * @param result result of the job
+ */
+static void
+finish_job (struct GNUNET_CRYPTO_OffloadJob *job,
+            int result)
+{
+  static const char c = 0;
+  const struct GNUNET_DISK_FileHandle *wh;
+
+  job->result = result;
+  job->state = JOB_DONE;
+  if (NULL == done_head)
+  {
+    /* the main loop drains the pipe before emptying the queue,
+       so one byte per transition to non-empty is enough */
+    wh = GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                  GNUNET_DISK_PIPE_END_WRITE);
+    (void) GNUNET_DISK_file_write (wh, &c, sizeof (c));
+  }
+  GNUNET_CONTAINER_DLL_insert_tail (done_head,
+                                    done_tail,
+                                    job);
+}
+
+
+#if HAVE_PTHREAD
+/**
+ * Main function of a worker thread.
+ *
+ * @param cls NULL
+ * @return never
+ */
+static void *
+worker_main (void *cls)
+{
+  struct GNUNET_CRYPTO_OffloadJob *job;
+  int result;
+
+  LOCK ();
+  while (1)
+  {
+    while (NULL == (job = pending_head))
+      GNUNET_assert (0 == pthread_cond_wait (&work_cond, &lock));
+    GNUNET_CONTAINER_DLL_remove (pending_head,
+                                 pending_tail,
+                                 job);
+    job->state = JOB_RUNNING;
+    UNLOCK ();
+    result = job->work (job->work_cls);
+    LOCK ();
+    finish_job (job, result);
+    GNUNET_assert (0 == pthread_cond_broadcast (&done_cond));
+  }
+  return NULL;
+}
+#endif
+
+
+/**
+ * Free a job.
+ *
+ * @param job job to free
+ */
+static void
+destroy_job (struct GNUNET_CRYPTO_OffloadJob *job)
+{
+  GNUNET_free_non_null (job->owned);
+  GNUNET_free (job);
+}
+
+
+/**
+ * Stop waiting for the workers if there is nothing left to do, so
+ * that the offload pool does not keep the scheduler running.
+ */
+static void
+check_idle ()
+{
+  if ( (0 == jobs_outstanding) &&
+       (NULL != wakeup_task) )
+  {
+    GNUNET_SCHEDULER_cancel (wakeup_task);
+    wakeup_task = NULL;
+  }
+}
+
+
+/**
+ * The workers finished some jobs.  Call their continuations.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+deliver_results (void *cls,
+                 const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  const struct GNUNET_DISK_FileHandle *rh;
+  struct GNUNET_CRYPTO_OffloadJob *job;
+  char buf[64];
+
+  wakeup_task = NULL;
+  rh = GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                GNUNET_DISK_PIPE_END_READ);
+  /* drain first, results queued after this will write again */
+  while (sizeof (buf) == GNUNET_DISK_file_read (rh, buf, sizeof (buf)))
+    ;
+  while (1)
+  {
+    /* one at a time, as a continuation may cancel other jobs */
+    LOCK ();
+    if (NULL != (job = done_head))
+      GNUNET_CONTAINER_DLL_remove (done_head,
+                                   done_tail,
+                                   job);
+    UNLOCK ();
+    if (NULL == job)
+      break;
+    GNUNET_assert (0 < jobs_outstanding);
+    jobs_outstanding--;
+    job->cont (job->cont_cls,
+               job->result);
+    destroy_job (job);
+  }
+  if ( (0 < jobs_outstanding) &&
+       (NULL == wakeup_task) )
+    wakeup_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                  rh,
+                                                  &deliver_results,
+                                                  NULL);
+}
+
+
+/**
+ * Create the wakeup pipe and start the workers.
+ *
+ * @return #GNUNET_OK on success
+ */
+static int
+init_pool ()
+{
+#if HAVE_PTHREAD
+  pthread_t thread;
+  long cpus;
+  unsigned int want;
+#endif
+
+  if (NULL != wakeup_pipe)
+    return GNUNET_OK;
+  wakeup_pipe = GNUNET_DISK_pipe (GNUNET_NO, GNUNET_NO, GNUNET_NO, GNUNET_NO);
+  if (NULL == wakeup_pipe)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_ERROR, "pipe");
+    return GNUNET_SYSERR;
+  }
+#if HAVE_PTHREAD
+  want = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+  cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cpus > 1)
+    want = GNUNET_MIN ((unsigned int) cpus, MAX_WORKERS);
+#endif
+  for (num_workers = 0; num_workers < want; num_workers++)
+  {
+    if (0 != pthread_create (&thread, NULL, &worker_main, NULL))
+    {
+      LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "pthread_create");
+      break;
+    }
+    GNUNET_break (0 == pthread_detach (thread));
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Started %u crypto offload workers\n",
+       num_workers);
+#endif
+  return GNUNET_OK;
+}
+
+
+/**
+ * Run @a work in a worker thread and pass its result to @a cont
+ * from the scheduler.
+ *
+ * @param work function to run in a worker thread
+ * @param work_cls closure for @a work
+ * @param cont function to call with the result
+ * @param cont_cls closure for @a cont
+ * @param owned memory to free with the job, can be NULL
+ * @return handle to cancel the job
+ */
+static struct GNUNET_CRYPTO_OffloadJob *
+offload_job (GNUNET_CRYPTO_OffloadFunction work,
+             void *work_cls,
+             GNUNET_CRYPTO_OffloadContinuation cont,
+             void *cont_cls,
+             void *owned)
+{
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  GNUNET_assert (GNUNET_OK == init_pool ());
+  job = GNUNET_new (struct GNUNET_CRYPTO_OffloadJob);
+  job->work = work;
+  job->work_cls = work_cls;
+  job->cont = cont;
+  job->cont_cls = cont_cls;
+  job->owned = owned;
+  job->state = JOB_PENDING;
+  jobs_outstanding++;
+  if (NULL == wakeup_task)
+    wakeup_task =
+      GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                      GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                                               GNUNET_DISK_PIPE_END_READ),
+                                      &deliver_results,
+                                      NULL);
+#if HAVE_PTHREAD
+  if (0 < num_workers)
+  {
+    LOCK ();
+    GNUNET_CONTAINER_DLL_insert_tail (pending_head,
+                                      pending_tail,
+                                      job);
+    GNUNET_assert (0 == pthread_cond_signal (&work_cond));
+    UNLOCK ();
+    return job;
+  }
+#endif
+  /* no workers, do it ourselves */
+  finish_job (job, work (work_cls));
+  return job;
+}
+
+
+/**
+ * Run @a work in a worker thread and pass its result to @a cont
+ * from the scheduler.  If the platform has no thread support, @a work
+ * is run right away, but @a cont is still called from a separate
+ * scheduler task.
+ *
+ * @param work function to run in a worker thread
+ * @param work_cls closure for @a work, must remain valid until
+ *        @a cont was called or the job was cancelled
+ * @param cont function to call with the result
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_offload (GNUNET_CRYPTO_OffloadFunction work,
+                       void *work_cls,
+                       GNUNET_CRYPTO_OffloadContinuation cont,
+                       void *cont_cls)
+{
+  return offload_job (work, work_cls, cont, cont_cls, NULL);
+}
+
+
+/**
+ * Cancel an offloaded job; its continuation will not be called.  If
+ * the job is running right now, waits until the worker is done with
+ * it.
+ *
+ * @param job job to cancel
+ */
+void
+GNUNET_CRYPTO_offload_cancel (struct GNUNET_CRYPTO_OffloadJob *job)
+{
+  LOCK ();
+#if HAVE_PTHREAD
+  while (JOB_RUNNING == job->state)
+    GNUNET_assert (0 == pthread_cond_wait (&done_cond, &lock));
+#endif
+  if (JOB_PENDING == job->state)
+    GNUNET_CONTAINER_DLL_remove (pending_head,
+                                 pending_tail,
+                                 job);
+  else
+    GNUNET_CONTAINER_DLL_remove (done_head,
+                                 done_tail,
+                                 job);
+  UNLOCK ();
+  GNUNET_assert (0 < jobs_outstanding);
+  jobs_outstanding--;
+  destroy_job (job);
+  check_idle ();
+}
+
+
+/**
+ * Allocate the arguments for a typed job.
+ *
+ * @param purpose block to copy after the struct, can be NULL
+ * @return the arguments
+ */
+static struct TypedJob *
+typed_job_new (const struct GNUNET_CRYPTO_EccSignaturePurpose *purpose)
+{
+  struct TypedJob *tj;
+  size_t psize;
+
+  psize = (NULL == purpose) ? 0 : ntohl (purpose->size);
+  tj = GNUNET_malloc (sizeof (struct TypedJob) + psize);
+  if (NULL != purpose)
+  {
+    tj->purpose = (struct GNUNET_CRYPTO_EccSignaturePurpose *) &tj[1];
+    memcpy (tj->purpose, purpose, psize);
+  }
+  return tj;
+}
+
+
+/**
+ * Worker side of #GNUNET_CRYPTO_eddsa_verify_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @return #GNUNET_OK if the signature is valid
+ */
+static int
+do_eddsa_verify (void *cls)
+{
+  struct TypedJob *tj = cls;
+
+  return GNUNET_CRYPTO_eddsa_verify_nolog (tj->purpose_type,
+                                           tj->purpose,
+                                           &tj->sig.eddsa,
+                                           &tj->pub.eddsa);
+}
+
+
+/**
+ * Worker side of #GNUNET_CRYPTO_ecdsa_verify_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @return #GNUNET_OK if the signature is valid
+ */
+static int
+do_ecdsa_verify (void *cls)
+{
+  struct TypedJob *tj = cls;
+
+  return GNUNET_CRYPTO_ecdsa_verify_nolog (tj->purpose_type,
+                                           tj->purpose,
+                                           &tj->sig.ecdsa,
+                                           &tj->pub.ecdsa);
+}
+
+
+/**
+ * Main loop side of the verification helpers.  Logs failed
+ * verifications, as the workers must not log.
+ *
+ * @param cls the `struct TypedJob`
+ * @param result result of the verification
+ */
+static void
+verify_done (void *cls,
+             int result)
+{
+  struct TypedJob *tj = cls;
+
+  if (GNUNET_OK != result)
+    LOG (GNUNET_ERROR_TYPE_INFO,
+         "Signature verification failed (purpose %u)\n",
+         (unsigned int) tj->purpose_type);
+  tj->cont.verify (tj->cont_cls,
+                   result);
+}
+
+
+/**
+ * Verify an EdDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @param cont function to call with #GNUNET_OK if the signature is
+ *        valid, #GNUNET_SYSERR if not
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_eddsa_verify_offload (uint32_t purpose,
+                                    const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                    const struct GNUNET_CRYPTO_EddsaSignature *sig,
+                                    const struct GNUNET_CRYPTO_EddsaPublicKey *pub,
+                                    GNUNET_CRYPTO_OffloadContinuation cont,
+                                    void *cont_cls)
+{
+  struct TypedJob *tj;
+
+  tj = typed_job_new (validate);
+  tj->cont.verify = cont;
+  tj->cont_cls = cont_cls;
+  tj->purpose_type = purpose;
+  tj->sig.eddsa = *sig;
+  tj->pub.eddsa = *pub;
+  return offload_job (&do_eddsa_verify, tj,
+                      &verify_done, tj,
+                      tj);
+}
+
+
+/**
+ * Verify an ECDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param purpose what is the purpose that the signature should have?
+ * @param validate block to validate (size, purpose, data)
+ * @param sig signature that is being validated
+ * @param pub public key of the signer
+ * @param cont function to call with #GNUNET_OK if the signature is
+ *        valid, #GNUNET_SYSERR if not
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_ecdsa_verify_offload (uint32_t purpose,
+                                    const struct GNUNET_CRYPTO_EccSignaturePurpose *validate,
+                                    const struct GNUNET_CRYPTO_EcdsaSignature *sig,
+                                    const struct GNUNET_CRYPTO_EcdsaPublicKey *pub,
+                                    GNUNET_CRYPTO_OffloadContinuation cont,
+                                    void *cont_cls)
+{
+  struct TypedJob *tj;
+
+  tj = typed_job_new (validate);
+  tj->cont.verify = cont;
+  tj->cont_cls = cont_cls;
+  tj->purpose_type = purpose;
+  tj->sig.ecdsa = *sig;
+  tj->pub.ecdsa = *pub;
+  return offload_job (&do_ecdsa_verify, tj,
+                      &verify_done, tj,
+                      tj);
+}
+
+
+/**
+ * Worker side of #GNUNET_CRYPTO_eddsa_sign_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @return #GNUNET_OK on success
+ */
+static int
+do_eddsa_sign (void *cls)
+{
+  struct TypedJob *tj = cls;
+
+  return GNUNET_CRYPTO_eddsa_sign (&tj->priv.eddsa,
+                                   tj->purpose,
+                                   &tj->sig.eddsa);
+}
+
+
+/**
+ * Main loop side of #GNUNET_CRYPTO_eddsa_sign_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @param result result of the signing
+ */
+static void
+sign_done (void *cls,
+           int result)
+{
+  struct TypedJob *tj = cls;
+
+  tj->cont.sign (tj->cont_cls,
+                 (GNUNET_OK == result) ? &tj->sig.eddsa : NULL);
+}
+
+
+/**
+ * Create an EdDSA signature in the crypto offload pool.  The
+ * arguments are copied.
+ *
+ * @param priv private key to use for the signing
+ * @param purpose what to sign (size, purpose, data)
+ * @param cont function to call with the signature
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_eddsa_sign_offload (const struct GNUNET_CRYPTO_EddsaPrivateKey *priv,
+                                  const struct GNUNET_CRYPTO_EccSignaturePurpose *purpose,
+                                  GNUNET_CRYPTO_EddsaSignContinuation cont,
+                                  void *cont_cls)
+{
+  struct TypedJob *tj;
+
+  tj = typed_job_new (purpose);
+  tj->cont.sign = cont;
+  tj->cont_cls = cont_cls;
+  tj->priv.eddsa = *priv;
+  return offload_job (&do_eddsa_sign, tj,
+                      &sign_done, tj,
+                      tj);
+}
+
+
+/**
+ * Worker side of #GNUNET_CRYPTO_ecc_ecdh_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @return #GNUNET_OK on success
+ */
+static int
+do_ecdh (void *cls)
+{
+  struct TypedJob *tj = cls;
+
+  return GNUNET_CRYPTO_ecc_ecdh (&tj->priv.ecdhe,
+                                 &tj->pub.ecdhe,
+                                 &tj->key_material);
+}
+
+
+/**
+ * Main loop side of #GNUNET_CRYPTO_ecc_ecdh_offload().
+ *
+ * @param cls the `struct TypedJob`
+ * @param result result of the ECDH
+ */
+static void
+ecdh_done (void *cls,
+           int result)
+{
+  struct TypedJob *tj = cls;
+
+  tj->cont.ecdh (tj->cont_cls,
+                 (GNUNET_OK == result) ? &tj->key_material : NULL);
+}
+
+
+/**
+ * Derive key material from a public and a private ECC key in the
+ * crypto offload pool.  The arguments are copied.
+ *
+ * @param priv private key to use for the ECDH (x)
+ * @param pub public key to use for the ECDH (yG)
+ * @param cont function to call with the key material (xyG)
+ * @param cont_cls closure for @a cont
+ * @return handle to cancel the job
+ */
+struct GNUNET_CRYPTO_OffloadJob *
+GNUNET_CRYPTO_ecc_ecdh_offload (const struct GNUNET_CRYPTO_EcdhePrivateKey *priv,
+                                const struct GNUNET_CRYPTO_EcdhePublicKey *pub,
+                                GNUNET_CRYPTO_EcdhContinuation cont,
+                                void *cont_cls)
+{
+  struct TypedJob *tj;
+
+  tj = typed_job_new (NULL);
+  tj->cont.ecdh = cont;
+  tj->cont_cls = cont_cls;
+  tj->priv.ecdhe = *priv;
+  tj->pub.ecdhe = *pub;
+  return offload_job (&do_ecdh, tj,
+                      &ecdh_done, tj,
+                      tj);
+}
+
+/* end of crypto_offload.c */
@@ -75,6 +75,14 @@ GNUNET_CRYPTO_paillier_create (struct GNUNET_CRYPTO_PaillierPublicKey *public_ke
                                     sizeof (struct GNUNET_CRYPTO_PaillierPublicKey),
                                     n);
 
+  /* keep p and q for decryption using the CRT */
+  GNUNET_CRYPTO_mpi_print_unsigned (private_key->p,
+                                    sizeof (private_key->p),
+                                    p);
+  GNUNET_CRYPTO_mpi_print_unsigned (private_key->q,
+                                    sizeof (private_key->q),
+                                    q);
+
   /* compute phi(n) = (p-1)(q-1) */
   GNUNET_assert (NULL != (phi = gcry_mpi_new (0)));
   gcry_mpi_sub_ui (p, p, 1);
@@ -198,32 +206,174 @@ GNUNET_CRYPTO_paillier_encrypt1 (const struct GNUNET_CRYPTO_PaillierPublicKey *p
 
 
 /**
- * Encrypt a plaintext with a paillier public key.
- *
- * @param public_key Public key to use.
- * @param m Plaintext to encrypt.
- * @param desired_ops How many homomorphic ops the caller intends to use
- * @param[out] ciphertext Encrytion of @a plaintext with @a public_key.
- * @return guaranteed number of supported homomorphic operations >= 1,
- *         or desired_ops, in case that is lower,
- *         or -1 if less than one homomorphic operation is possible
+ * How many r^n values does one refill job of a
+ * `struct GNUNET_CRYPTO_PaillierRandomPool` compute?
  */
-int
-GNUNET_CRYPTO_paillier_encrypt (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
-                                const gcry_mpi_t m,
-                                int desired_ops,
-                                struct GNUNET_CRYPTO_PaillierCiphertext *ciphertext)
+#define POOL_REFILL_BATCH 8
+
+/**
+ * How many refill jobs may run concurrently for one pool?
+ */
+#define POOL_MAX_JOBS 4
+
+
+/**
+ * Job computing r^n values for a pool in the crypto offload pool.
+ */
+struct RefillJob
 {
-  int possible_opts;
+  /**
+   * Pool we are refilling.
+   */
+  struct GNUNET_CRYPTO_PaillierRandomPool *pool;
+
+  /**
+   * Handle for the job, NULL if this slot is idle.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * Values computed by the job.
+   */
+  gcry_mpi_t values[POOL_REFILL_BATCH];
+};
+
+
+/**
+ * Pool of precomputed r^n mod n^2 values for one public key.
+ */
+struct GNUNET_CRYPTO_PaillierRandomPool
+{
+  /**
+   * Public key the values are for.
+   */
+  struct GNUNET_CRYPTO_PaillierPublicKey public_key;
+
+  /**
+   * N value of @e public_key.  Only read by the workers.
+   */
+  gcry_mpi_t n;
+
+  /**
+   * N^2.  Only read by the workers.
+   */
   gcry_mpi_t n_square;
+
+  /**
+   * Array of @e size values, the first @e fill are ready for use.
+   */
+  gcry_mpi_t *values;
+
+  /**
+   * Jobs refilling @e values.
+   */
+  struct RefillJob jobs[POOL_MAX_JOBS];
+
+  /**
+   * Capacity of @e values.
+   */
+  unsigned int size;
+
+  /**
+   * Number of ready values in @e values.
+   */
+  unsigned int fill;
+
+  /**
+   * Highest bit set in @e n.
+   */
+  unsigned int highbit;
+};
+
+
+/**
+ * Parse a public key.
+ *
+ * @param public_key key to parse
+ * @param[out] n set to the N value of @a public_key
+ * @param[out] n_square set to N^2
+ * @param[out] highbit set to the highest bit set in @a n
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the key is invalid
+ */
+static int
+parse_public_key (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                  gcry_mpi_t *n,
+                  gcry_mpi_t *n_square,
+                  unsigned int *highbit)
+{
+  GNUNET_CRYPTO_mpi_scan_unsigned (n,
+                                   public_key,
+                                   sizeof (struct GNUNET_CRYPTO_PaillierPublicKey));
+
+  /* check public key for number of bits, bail out if key is all zeros */
+  *highbit = GNUNET_CRYPTO_PAILLIER_BITS - 1;
+  while ( (! gcry_mpi_test_bit (*n, *highbit)) &&
+          (0 != *highbit) )
+    (*highbit)--;
+  if (0 == *highbit)
+  {
+    /* invalid public key */
+    GNUNET_break_op (0);
+    gcry_mpi_release (*n);
+    return GNUNET_SYSERR;
+  }
+  /* n_square = n^2 */
+  GNUNET_assert (0 != (*n_square = gcry_mpi_new (0)));
+  gcry_mpi_mul (*n_square,
+                *n,
+                *n);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Compute r^n mod n^2 for a fresh random r < n.  This is the
+ * expensive part of an encryption; it does not depend on the
+ * plaintext and can thus be precomputed.  Thread-safe.
+ *
+ * @param n N value of the public key
+ * @param n_square N^2
+ * @param highbit highest bit set in @a n
+ * @return r^n mod n^2
+ */
+static gcry_mpi_t
+random_rn (const gcry_mpi_t n,
+           const gcry_mpi_t n_square,
+           unsigned int highbit)
+{
   gcry_mpi_t r;
   gcry_mpi_t rn;
-  gcry_mpi_t g;
-  gcry_mpi_t gm;
-  gcry_mpi_t c;
-  gcry_mpi_t n;
+
+  /* generate r < n (without bias) */
+  GNUNET_assert (NULL != (r = gcry_mpi_new (0)));
+  do {
+    gcry_mpi_randomize (r, highbit + 1, GCRY_STRONG_RANDOM);
+  }
+  while (gcry_mpi_cmp (r, n) >= 0);
+
+  /* rn <- r^n mod n^2 */
+  GNUNET_assert (0 != (rn = gcry_mpi_new (0)));
+  gcry_mpi_powm (rn, r, n, n_square);
+  gcry_mpi_release (r);
+  return rn;
+}
+
+
+/**
+ * Determine how many homomorphic operations we could allow on the
+ * encryption of @a m, assuming the other number has the same length
+ * (or is smaller).
+ *
+ * @param m plaintext
+ * @param desired_ops soft-cap by the caller
+ * @return number of possible operations
+ */
+static int
+get_possible_ops (const gcry_mpi_t m,
+                  int desired_ops)
+{
+  int possible_opts;
   gcry_mpi_t max_num;
-  unsigned int highbit;
 
   /* set max_num = 2^{GNUNET_CRYPTO_PAILLIER_BITS}, the largest
      number we can have as a result */
@@ -232,11 +382,10 @@ GNUNET_CRYPTO_paillier_encrypt (const struct GNUNET_CRYPTO_PaillierPublicKey *pu
                      max_num,
                      GNUNET_CRYPTO_PAILLIER_BITS);
 
-  /* Determine how many operations we could allow, assuming the other
-     number has the same length (or is smaller), by counting the
-     number of possible operations.  We essentially divide max_num by
-     2 until the result is no longer larger than 'm', incrementing the
-     maximum number of operations in each round, starting at -2 */
+  /* Count the number of possible operations.  We essentially divide
+     max_num by 2 until the result is no longer larger than 'm',
+     incrementing the maximum number of operations in each round,
+     starting at -2 */
   for (possible_opts = -2; gcry_mpi_cmp (max_num, m) > 0; possible_opts++)
     gcry_mpi_div (max_num,
                   NULL,
@@ -248,67 +397,326 @@ GNUNET_CRYPTO_paillier_encrypt (const struct GNUNET_CRYPTO_PaillierPublicKey *pu
   if (possible_opts < 1)
     possible_opts = 0;
   /* Enforce soft-cap by caller */
-  possible_opts = GNUNET_MIN (desired_ops, possible_opts);
-  ciphertext->remaining_ops = htonl (possible_opts);
-
-  GNUNET_CRYPTO_mpi_scan_unsigned (&n,
-                                   public_key,
-                                   sizeof (struct GNUNET_CRYPTO_PaillierPublicKey));
-
-  /* check public key for number of bits, bail out if key is all zeros */
-  highbit = GNUNET_CRYPTO_PAILLIER_BITS - 1;
-  while ( (! gcry_mpi_test_bit (n, highbit)) &&
-          (0 != highbit) )
-    highbit--;
-  if (0 == highbit)
-  {
-    /* invalid public key */
-    GNUNET_break_op (0);
-    gcry_mpi_release (n);
-    return GNUNET_SYSERR;
-  }
-
-  /* generate r < n (without bias) */
-  GNUNET_assert (NULL != (r = gcry_mpi_new (0)));
-  do {
-    gcry_mpi_randomize (r, highbit + 1, GCRY_STRONG_RANDOM);
-  }
-  while (gcry_mpi_cmp (r, n) >= 0);
+  return GNUNET_MIN (desired_ops, possible_opts);
+}
 
-  /* g = n + 1 */
-  GNUNET_assert (0 != (g = gcry_mpi_new (0)));
-  gcry_mpi_add_ui (g, n, 1);
 
-  /* n_square = n^2 */
-  GNUNET_assert (0 != (n_square = gcry_mpi_new (0)));
-  gcry_mpi_mul (n_square,
-                n,
-                n);
+/**
+ * Encrypt @a m given a precomputed r^n.  As we use g = n + 1, we
+ * have g^m = 1 + m * n mod n^2, so this needs no exponentiation.
+ *
+ * @param n N value of the public key
+ * @param n_square N^2
+ * @param m plaintext
+ * @param rn r^n mod n^2 for a random r
+ * @param[out] ciphertext where to write the result
+ */
+static void
+encrypt_with_rn (const gcry_mpi_t n,
+                 const gcry_mpi_t n_square,
+                 const gcry_mpi_t m,
+                 const gcry_mpi_t rn,
+                 struct GNUNET_CRYPTO_PaillierCiphertext *ciphertext)
+{
+  gcry_mpi_t gm;
+  gcry_mpi_t c;
 
-  /* gm = g^m mod n^2 */
+  /* gm = 1 + m * n mod n^2 */
   GNUNET_assert (0 != (gm = gcry_mpi_new (0)));
-  gcry_mpi_powm (gm, g, m, n_square);
-  gcry_mpi_release (g);
-
-  /* rn <- r^n mod n^2 */
-  GNUNET_assert (0 != (rn = gcry_mpi_new (0)));
-  gcry_mpi_powm (rn, r, n, n_square);
-  gcry_mpi_release (r);
-  gcry_mpi_release (n);
+  gcry_mpi_mul (gm, m, n);
+  gcry_mpi_add_ui (gm, gm, 1);
+  gcry_mpi_mod (gm, gm, n_square);
 
   /* c <- rn * gm mod n^2 */
   GNUNET_assert (0 != (c = gcry_mpi_new (0)));
   gcry_mpi_mulm (c, rn, gm, n_square);
-  gcry_mpi_release (n_square);
   gcry_mpi_release (gm);
-  gcry_mpi_release (rn);
 
   GNUNET_CRYPTO_mpi_print_unsigned (ciphertext->bits,
                                     sizeof (ciphertext->bits),
                                     c);
   gcry_mpi_release (c);
+}
 
-  return possible_opts;
+
+/**
+ * Start refill jobs for @a pool until the values it has and the
+ * values being computed would fill it.
+ *
+ * @param pool pool to refill
+ */
+static void
+pool_refill (struct GNUNET_CRYPTO_PaillierRandomPool *pool);
+
+
+/**
+ * Compute a batch of r^n values, run in a worker thread.
+ *
+ * @param cls the `struct RefillJob`
+ * @return #GNUNET_OK
+ */
+static int
+refill_job (void *cls)
+{
+  struct RefillJob *job = cls;
+  struct GNUNET_CRYPTO_PaillierRandomPool *pool = job->pool;
+  unsigned int i;
+
+  for (i=0;i<POOL_REFILL_BATCH;i++)
+    job->values[i] = random_rn (pool->n,
+                                pool->n_square,
+                                pool->highbit);
+  return GNUNET_OK;
+}
+
+
+/**
+ * A refill job is done, move its values into the pool.
+ *
+ * @param cls the `struct RefillJob`
+ * @param result #GNUNET_OK
+ */
+static void
+refill_job_done (void *cls,
+                 int result)
+{
+  struct RefillJob *job = cls;
+  struct GNUNET_CRYPTO_PaillierRandomPool *pool = job->pool;
+  unsigned int i;
+
+  job->job = NULL;
+  for (i=0;i<POOL_REFILL_BATCH;i++)
+  {
+    if (pool->fill < pool->size)
+      pool->values[pool->fill++] = job->values[i];
+    else
+      gcry_mpi_release (job->values[i]);
+    job->values[i] = NULL;
+  }
+  pool_refill (pool);
+}
+
+
+/**
+ * Start refill jobs for @a pool until the values it has and the
+ * values being computed would fill it.
+ *
+ * @param pool pool to refill
+ */
+static void
+pool_refill (struct GNUNET_CRYPTO_PaillierRandomPool *pool)
+{
+  unsigned int pending;
+  unsigned int i;
+
+  pending = pool->fill;
+  for (i=0;i<POOL_MAX_JOBS;i++)
+    if (NULL != pool->jobs[i].job)
+      pending += POOL_REFILL_BATCH;
+  for (i=0;i<POOL_MAX_JOBS;i++)
+  {
+    if (pending >= pool->size)
+      return;
+    if (NULL != pool->jobs[i].job)
+      continue;
+    pool->jobs[i].job = GNUNET_CRYPTO_offload (&refill_job,
+                                               &pool->jobs[i],
+                                               &refill_job_done,
+                                               &pool->jobs[i]);
+    pending += POOL_REFILL_BATCH;
+  }
+}
+
+
+/**
+ * Create a pool of precomputed values for encryptions with
+ * @a public_key.  The pool is filled in the background using the
+ * crypto offload pool, and refilled as values are used up.  Must be
+ * called from within the scheduler.
+ *
+ * @param public_key key the values are for
+ * @param size number of values to keep ready
+ * @return NULL if @a public_key is invalid
+ */
+struct GNUNET_CRYPTO_PaillierRandomPool *
+GNUNET_CRYPTO_paillier_pool_create (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                    unsigned int size)
+{
+  struct GNUNET_CRYPTO_PaillierRandomPool *pool;
+  unsigned int i;
+
+  pool = GNUNET_new (struct GNUNET_CRYPTO_PaillierRandomPool);
+  if (GNUNET_OK !=
+      parse_public_key (public_key,
+                        &pool->n,
+                        &pool->n_square,
+                        &pool->highbit))
+  {
+    GNUNET_free (pool);
+    return NULL;
+  }
+  pool->public_key = *public_key;
+  pool->size = size;
+  pool->values = GNUNET_new_array (size,
+                                   gcry_mpi_t);
+  for (i=0;i<POOL_MAX_JOBS;i++)
+    pool->jobs[i].pool = pool;
+  pool_refill (pool);
+  return pool;
+}
+
+
+/**
+ * Obtain the number of precomputed values that are ready for use.
+ *
+ * @param pool pool to inspect
+ * @return number of encryptions that can be done without a modular
+ *         exponentiation right now
+ */
+unsigned int
+GNUNET_CRYPTO_paillier_pool_get_available (const struct GNUNET_CRYPTO_PaillierRandomPool *pool)
+{
+  return pool->fill;
+}
+
+
+/**
+ * Destroy a pool of precomputed values.
+ *
+ * @param pool pool to destroy
+ */
+void
+GNUNET_CRYPTO_paillier_pool_destroy (struct GNUNET_CRYPTO_PaillierRandomPool *pool)
+{
+  unsigned int i;
+  unsigned int j;
+
+  for (i=0;i<POOL_MAX_JOBS;i++)
+  {
+    if (NULL == pool->jobs[i].job)
+      continue;
+    GNUNET_CRYPTO_offload_cancel (pool->jobs[i].job);
+    pool->jobs[i].job = NULL;
+    for (j=0;j<POOL_REFILL_BATCH;j++)
+      if (NULL != pool->jobs[i].values[j])
+        gcry_mpi_release (pool->jobs[i].values[j]);
+  }
+  for (i=0;i<pool->fill;i++)
+    gcry_mpi_release (pool->values[i]);
+  GNUNET_free (pool->values);
+  gcry_mpi_release (pool->n);
+  gcry_mpi_release (pool->n_square);
+  GNUNET_free (pool);
+}
+
+
+/**
+ * Encrypt a plaintext with a paillier public key.
+ *
+ * @param public_key Public key to use.
+ * @param m Plaintext to encrypt.
+ * @param desired_ops How many homomorphic ops the caller intends to use
+ * @param[out] ciphertext Encrytion of @a plaintext with @a public_key.
+ * @return guaranteed number of supported homomorphic operations >= 1,
+ *         or desired_ops, in case that is lower,
+ *         or -1 if less than one homomorphic operation is possible
+ */
+int
+GNUNET_CRYPTO_paillier_encrypt (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                const gcry_mpi_t m,
+                                int desired_ops,
+                                struct GNUNET_CRYPTO_PaillierCiphertext *ciphertext)
+{
+  return GNUNET_CRYPTO_paillier_encrypt_batch (public_key,
+                                               NULL,
+                                               &m,
+                                               1,
+                                               desired_ops,
+                                               ciphertext);
+}
+
+
+/**
+ * Encrypt a number of plaintexts with a paillier public key.  Cheaper
+ * than individual calls to #GNUNET_CRYPTO_paillier_encrypt() as the
+ * key is only parsed once, and as precomputed values from @a pool
+ * are used while it has any.
+ *
+ * @param public_key Public key to use.
+ * @param pool precomputed values for @a public_key, or NULL
+ * @param m array of @a count plaintexts to encrypt
+ * @param count number of plaintexts
+ * @param desired_ops How many homomorphic ops the caller intends to use
+ * @param[out] ciphertexts array of @a count encryptions of @a m
+ * @return guaranteed number of supported homomorphic operations for
+ *         all ciphertexts, or desired_ops, in case that is lower,
+ *         or #GNUNET_SYSERR if @a public_key is invalid
+ */
+int
+GNUNET_CRYPTO_paillier_encrypt_batch (const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                      struct GNUNET_CRYPTO_PaillierRandomPool *pool,
+                                      const gcry_mpi_t *m,
+                                      unsigned int count,
+                                      int desired_ops,
+                                      struct GNUNET_CRYPTO_PaillierCiphertext *ciphertexts)
+{
+  int min_opts;
+  int possible_opts;
+  gcry_mpi_t n_square;
+  gcry_mpi_t rn;
+  gcry_mpi_t n;
+  unsigned int highbit;
+  unsigned int i;
+  int used_pool;
+
+  if ( (NULL != pool) &&
+       (0 != memcmp (&pool->public_key,
+                     public_key,
+                     sizeof (struct GNUNET_CRYPTO_PaillierPublicKey))) )
+  {
+    /* pool is for a different key */
+    GNUNET_break (0);
+    pool = NULL;
+  }
+  if (GNUNET_OK !=
+      parse_public_key (public_key,
+                        &n,
+                        &n_square,
+                        &highbit))
+    return GNUNET_SYSERR;
+  min_opts = desired_ops;
+  used_pool = GNUNET_NO;
+  for (i=0;i<count;i++)
+  {
+    possible_opts = get_possible_ops (m[i],
+                                      desired_ops);
+    ciphertexts[i].remaining_ops = htonl (possible_opts);
+    min_opts = GNUNET_MIN (min_opts,
+                           possible_opts);
+    if ( (NULL != pool) &&
+         (0 < pool->fill) )
+    {
+      rn = pool->values[--pool->fill];
+      used_pool = GNUNET_YES;
+    }
+    else
+    {
+      rn = random_rn (n,
+                      n_square,
+                      highbit);
+    }
+    encrypt_with_rn (n,
+                     n_square,
+                     m[i],
+                     rn,
+                     &ciphertexts[i]);
+    gcry_mpi_release (rn);
+  }
+  if (GNUNET_YES == used_pool)
+    pool_refill (pool);
+  gcry_mpi_release (n_square);
+  gcry_mpi_release (n);
+  return min_opts;
 }
 
 
@@ -326,31 +734,34 @@ GNUNET_CRYPTO_paillier_decrypt (const struct GNUNET_CRYPTO_PaillierPrivateKey *p
                                 const struct GNUNET_CRYPTO_PaillierCiphertext *ciphertext,
                                 gcry_mpi_t m)
 {
-  gcry_mpi_t mu;
-  gcry_mpi_t lambda;
-  gcry_mpi_t n;
-  gcry_mpi_t n_square;
-  gcry_mpi_t c;
-  gcry_mpi_t cmu;
-  gcry_mpi_t cmum1;
-  gcry_mpi_t mod;
-
-  GNUNET_CRYPTO_mpi_scan_unsigned (&lambda,
-                                   private_key->lambda,
-                                   sizeof (private_key->lambda));
-  GNUNET_CRYPTO_mpi_scan_unsigned (&mu,
-                                   private_key->mu,
-                                   sizeof (private_key->mu));
-  GNUNET_CRYPTO_mpi_scan_unsigned (&n,
-                                   public_key,
-                                   sizeof (struct GNUNET_CRYPTO_PaillierPublicKey));
-  GNUNET_CRYPTO_mpi_scan_unsigned (&c,
-                                   ciphertext->bits,
-                                   sizeof (ciphertext->bits));
+  GNUNET_CRYPTO_paillier_decrypt_batch (private_key,
+                                        public_key,
+                                        ciphertext,
+                                        1,
+                                        &m);
+}
 
-  /* n_square = n * n */
-  GNUNET_assert (0 != (n_square = gcry_mpi_new (0)));
-  gcry_mpi_mul (n_square, n, n);
+
+/**
+ * Decrypt with lambda and mu, for private keys without the prime
+ * factors of n.
+ *
+ * @param lambda lambda-component of the private key
+ * @param mu mu-component of the private key
+ * @param n N value of the public key
+ * @param n_square N^2
+ * @param c ciphertext
+ * @param[out] m plaintext
+ */
+static void
+decrypt_lambda (const gcry_mpi_t lambda,
+                const gcry_mpi_t mu,
+                const gcry_mpi_t n,
+                const gcry_mpi_t n_square,
+                const gcry_mpi_t c,
+                gcry_mpi_t m)
+{
+  gcry_mpi_t cmu;
 
   /* cmu = c^lambda mod n^2 */
   GNUNET_assert (0 != (cmu = gcry_mpi_new (0)));
@@ -358,23 +769,157 @@ GNUNET_CRYPTO_paillier_decrypt (const struct GNUNET_CRYPTO_PaillierPrivateKey *p
                  c,
                  lambda,
                  n_square);
-  gcry_mpi_release (n_square);
-  gcry_mpi_release (lambda);
-  gcry_mpi_release (c);
-
-  /* cmum1 = cmu - 1 */
-  GNUNET_assert (0 != (cmum1 = gcry_mpi_new (0)));
-  gcry_mpi_sub_ui (cmum1, cmu, 1);
+  /* cmu = (cmu - 1) / n */
+  gcry_mpi_sub_ui (cmu, cmu, 1);
+  gcry_mpi_div (cmu, NULL, cmu, n, 0);
+  /* m = cmu * mu mod n */
+  gcry_mpi_mulm (m, cmu, mu, n);
   gcry_mpi_release (cmu);
+}
 
-  /* mod = cmum1 / n (mod n) */
-  GNUNET_assert (0 != (mod = gcry_mpi_new (0)));
-  gcry_mpi_div (mod, NULL, cmum1, n, 0);
 
-  /* m = mod * mu mod n */
-  gcry_mpi_mulm (m, mod, mu, n);
-  gcry_mpi_release (mu);
-  gcry_mpi_release (n);
+/**
+ * Compute L_p (c^{p-1} mod p^2) * h_p mod p, the decryption of @a c
+ * modulo the prime @a p.
+ *
+ * @param p prime factor of n
+ * @param p_square p^2
+ * @param h_p L_p (g^{p-1} mod p^2)^{-1} mod p
+ * @param c ciphertext
+ * @param[out] mp plaintext mod @a p
+ */
+static void
+decrypt_mod_prime (const gcry_mpi_t p,
+                   const gcry_mpi_t p_square,
+                   const gcry_mpi_t h_p,
+                   const gcry_mpi_t c,
+                   gcry_mpi_t mp)
+{
+  gcry_mpi_t pm1;
+
+  GNUNET_assert (0 != (pm1 = gcry_mpi_new (0)));
+  gcry_mpi_sub_ui (pm1, p, 1);
+  gcry_mpi_mod (mp, c, p_square);
+  gcry_mpi_powm (mp, mp, pm1, p_square);
+  gcry_mpi_release (pm1);
+  gcry_mpi_sub_ui (mp, mp, 1);
+  gcry_mpi_div (mp, NULL, mp, p, 0);
+  gcry_mpi_mulm (mp, mp, h_p, p);
+}
+
+
+/**
+ * Decrypt a number of paillier ciphertexts with a private key.  Uses
+ * the Chinese Remainder Theorem: the exponentiations are done modulo
+ * p^2 and q^2 with exponents of half the size instead of modulo n^2.
+ *
+ * @param private_key Private key to use for decryption.
+ * @param public_key Public key to use for decryption.
+ * @param ciphertexts array of @a count ciphertexts to decrypt
+ * @param count number of ciphertexts
+ * @param[out] m array of @a count initialized MPIs to store
+ *        the plaintexts in
+ */
+void
+GNUNET_CRYPTO_paillier_decrypt_batch (const struct GNUNET_CRYPTO_PaillierPrivateKey *private_key,
+                                      const struct GNUNET_CRYPTO_PaillierPublicKey *public_key,
+                                      const struct GNUNET_CRYPTO_PaillierCiphertext *ciphertexts,
+                                      unsigned int count,
+                                      gcry_mpi_t *m)
+{
+  gcry_mpi_t p;
+  gcry_mpi_t q;
+  gcry_mpi_t p_square;
+  gcry_mpi_t q_square;
+  gcry_mpi_t q_inv;
+  gcry_mpi_t h_p;
+  gcry_mpi_t h_q;
+  gcry_mpi_t lambda;
+  gcry_mpi_t mu;
+  gcry_mpi_t n;
+  gcry_mpi_t n_square;
+  gcry_mpi_t c;
+  gcry_mpi_t mp;
+  gcry_mpi_t mq;
+  unsigned int i;
+
+  GNUNET_CRYPTO_mpi_scan_unsigned (&p,
+                                   private_key->p,
+                                   sizeof (private_key->p));
+  GNUNET_CRYPTO_mpi_scan_unsigned (&q,
+                                   private_key->q,
+                                   sizeof (private_key->q));
+  if ( (0 == gcry_mpi_cmp_ui (p, 0)) ||
+       (0 == gcry_mpi_cmp_ui (q, 0)) )
+  {
+    /* key without prime factors, use lambda and mu */
+    gcry_mpi_release (p);
+    gcry_mpi_release (q);
+    GNUNET_CRYPTO_mpi_scan_unsigned (&lambda,
+                                     private_key->lambda,
+                                     sizeof (private_key->lambda));
+    GNUNET_CRYPTO_mpi_scan_unsigned (&mu,
+                                     private_key->mu,
+                                     sizeof (private_key->mu));
+    GNUNET_CRYPTO_mpi_scan_unsigned (&n,
+                                     public_key,
+                                     sizeof (struct GNUNET_CRYPTO_PaillierPublicKey));
+    GNUNET_assert (0 != (n_square = gcry_mpi_new (0)));
+    gcry_mpi_mul (n_square, n, n);
+    for (i=0;i<count;i++)
+    {
+      GNUNET_CRYPTO_mpi_scan_unsigned (&c,
+                                       ciphertexts[i].bits,
+                                       sizeof (ciphertexts[i].bits));
+      decrypt_lambda (lambda, mu, n, n_square, c, m[i]);
+      gcry_mpi_release (c);
+    }
+    gcry_mpi_release (lambda);
+    gcry_mpi_release (mu);
+    gcry_mpi_release (n);
+    gcry_mpi_release (n_square);
+    return;
+  }
+
+  GNUNET_assert (0 != (p_square = gcry_mpi_new (0)));
+  gcry_mpi_mul (p_square, p, p);
+  GNUNET_assert (0 != (q_square = gcry_mpi_new (0)));
+  gcry_mpi_mul (q_square, q, q);
+  /* As g = n + 1, L_p (g^{p-1} mod p^2) = (p-1) q = -q mod p,
+     so h_p = -q^{-1} mod p, and likewise h_q = -p^{-1} mod q */
+  GNUNET_assert (0 != (q_inv = gcry_mpi_new (0)));
+  GNUNET_assert (0 != gcry_mpi_invm (q_inv, q, p));
+  GNUNET_assert (0 != (h_p = gcry_mpi_new (0)));
+  gcry_mpi_sub (h_p, p, q_inv);
+  GNUNET_assert (0 != (h_q = gcry_mpi_new (0)));
+  GNUNET_assert (0 != gcry_mpi_invm (h_q, p, q));
+  gcry_mpi_sub (h_q, q, h_q);
+
+  GNUNET_assert (0 != (mp = gcry_mpi_new (0)));
+  GNUNET_assert (0 != (mq = gcry_mpi_new (0)));
+  for (i=0;i<count;i++)
+  {
+    GNUNET_CRYPTO_mpi_scan_unsigned (&c,
+                                     ciphertexts[i].bits,
+                                     sizeof (ciphertexts[i].bits));
+    decrypt_mod_prime (p, p_square, h_p, c, mp);
+    decrypt_mod_prime (q, q_square, h_q, c, mq);
+    gcry_mpi_release (c);
+    /* m = mq + q * ((mp - mq) * q^{-1} mod p) */
+    gcry_mpi_subm (mp, mp, mq, p);
+    gcry_mpi_mulm (mp, mp, q_inv, p);
+    gcry_mpi_mul (m[i], mp, q);
+    gcry_mpi_add (m[i], m[i], mq);
+  }
+  gcry_mpi_release (mp);
+  gcry_mpi_release (mq);
+  gcry_mpi_release (h_p);
+  gcry_mpi_release (h_q);
+  gcry_mpi_release (q_inv);
+  gcry_mpi_release (p_square);
+  gcry_mpi_release (q_square);
+  gcry_mpi_release (p);
+  gcry_mpi_release (q);
 }
 
 
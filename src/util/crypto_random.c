@@ -33,53 +33,50 @@
 #define LOG_STRERROR(kind,syscall) GNUNET_log_from_strerror (kind, "util", syscall)
 
 
-/* TODO: ndurner, move this to plibc? */
-/* The code is derived from glibc, obviously */
-#if !HAVE_RANDOM || !HAVE_SRANDOM
-#ifdef RANDOM
-#undef RANDOM
-#endif
-#ifdef SRANDOM
-#undef SRANDOM
-#endif
-#define RANDOM() glibc_weak_rand32()
-#define SRANDOM(s) glibc_weak_srand32(s)
-#if defined(RAND_MAX)
-#undef RAND_MAX
-#endif
-#define RAND_MAX 0x7fffffff /* Hopefully this is correct */
-
-
-static int32_t glibc_weak_rand32_state = 1;
+/**
+ * State of the weak PRNG (xoshiro256**).  Per-process; like the
+ * rest of the scheduler-driven code, not thread-safe.
+ */
+static uint64_t weak_state[4] = {
+  0x9E3779B97F4A7C15LLU, 0xBF58476D1CE4E5B9LLU,
+  0x94D049BB133111EBLLU, 0x2545F4914F6CDD1DLLU
+};
 
 
-void
-glibc_weak_srand32 (int32_t s)
+/**
+ * Rotate @a x left by @a k bits.
+ *
+ * @param x value to rotate
+ * @param k number of bits, in [1,63]
+ * @return rotated value
+ */
+static inline uint64_t
+rotl64 (uint64_t x, int k)
 {
-  glibc_weak_rand32_state = s;
+  return (x << k) | (x >> (64 - k));
 }
 
 
-int32_t
-glibc_weak_rand32 ()
-{
-  int32_t val = glibc_weak_rand32_state;
-
-  val = ((glibc_weak_rand32_state * 1103515245) + 12345) & 0x7fffffff;
-  glibc_weak_rand32_state = val;
-  return val;
-}
-#endif
-
 /**
- * Create a cryptographically weak pseudo-random number in the interval of 0 to 1.
+ * Create a cryptographically weak pseudo-random 64-bit number.
  *
- * @return number between 0 and 1.
+ * @return next value of the weak PRNG
  */
-static double
+static uint64_t
 get_weak_random ()
 {
-  return ((double) RANDOM () / RAND_MAX);
+  uint64_t result;
+  uint64_t t;
+
+  result = rotl64 (weak_state[1] * 5, 7) * 9;
+  t = weak_state[1] << 17;
+  weak_state[2] ^= weak_state[0];
+  weak_state[3] ^= weak_state[1];
+  weak_state[1] ^= weak_state[2];
+  weak_state[0] ^= weak_state[3];
+  weak_state[2] ^= t;
+  weak_state[3] = rotl64 (weak_state[3], 45);
+  return result;
 }
 
 
@@ -92,7 +89,21 @@ get_weak_random ()
 void
 GNUNET_CRYPTO_seed_weak_random (int32_t seed)
 {
-  SRANDOM (seed);
+  uint64_t x;
+  uint64_t z;
+  unsigned int i;
+
+  /* expand the seed with splitmix64, which never yields an
+     all-zero state */
+  x = (uint64_t) (uint32_t) seed;
+  for (i = 0; i < 4; i++)
+  {
+    x += 0x9E3779B97F4A7C15LLU;
+    z = x;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9LLU;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBLLU;
+    weak_state[i] = z ^ (z >> 31);
+  }
 }
 
 
@@ -110,6 +121,9 @@ GNUNET_CRYPTO_random_block (enum GNUNET_CRYPTO_Quality mode, void *buffer, size_
 #ifdef gcry_fast_random_poll
   static unsigned int invokeCount;
 #endif
+  char *cbuf;
+  uint64_t r;
+
   switch (mode)
   {
   case GNUNET_CRYPTO_QUALITY_STRONG:
@@ -124,12 +138,20 @@ GNUNET_CRYPTO_random_block (enum GNUNET_CRYPTO_Quality mode, void *buffer, size_
     gcry_create_nonce (buffer, length);
     return;
   case GNUNET_CRYPTO_QUALITY_WEAK:
-    /* see http://lists.gnupg.org/pipermail/gcrypt-devel/2004-May/000613.html */
-#ifdef gcry_fast_random_poll
-    if ((invokeCount++ % 256) == 0)
-      gcry_fast_random_poll ();
-#endif
-    gcry_randomize (buffer, length, GCRY_WEAK_RANDOM);
+    /* fill 8 bytes at a time from the weak PRNG */
+    cbuf = buffer;
+    while (length >= sizeof (uint64_t))
+    {
+      r = get_weak_random ();
+      memcpy (cbuf, &r, sizeof (uint64_t));
+      cbuf += sizeof (uint64_t);
+      length -= sizeof (uint64_t);
+    }
+    if (length > 0)
+    {
+      r = get_weak_random ();
+      memcpy (cbuf, &r, length);
+    }
     return;
   default:
     GNUNET_assert (0);
@@ -181,10 +203,9 @@ GNUNET_CRYPTO_random_u32 (enum GNUNET_CRYPTO_Quality mode,
     while (ret >= ul);
     return ret % i;
   case GNUNET_CRYPTO_QUALITY_WEAK:
-    ret = i * get_weak_random ();
-    if (ret >= i)
-      ret = i - 1;
-    return ret;
+    /* multiply-shift: maps the upper 32 bits onto [0,i[ without a
+       division; the bias of at most i/2^32 is fine for weak mode */
+    return (uint32_t) (((get_weak_random () >> 32) * (uint64_t) i) >> 32);
   default:
     GNUNET_assert (0);
   }
@@ -259,10 +280,13 @@ GNUNET_CRYPTO_random_u64 (enum GNUNET_CRYPTO_Quality mode, uint64_t max)
 
     return ret % max;
   case GNUNET_CRYPTO_QUALITY_WEAK:
-    ret = max * get_weak_random ();
-    if (ret >= max)
-      ret = max - 1;
-    return ret;
+    ul = UINT64_MAX - (UINT64_MAX % max);
+    do
+    {
+      ret = get_weak_random ();
+    }
+    while (ret >= ul);
+    return ret % max;
   default:
     GNUNET_assert (0);
   }
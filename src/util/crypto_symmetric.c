@@ -179,6 +179,350 @@ GNUNET_CRYPTO_symmetric_decrypt (const void *block, size_t size,
 }
 
 
+/**
+ * Keyed cipher context for repeated operations under the same
+ * session key.
+ */
+struct GNUNET_CRYPTO_SymmetricContext
+{
+
+  /**
+   * AES handle, keyed with the AES half of @e key.
+   */
+  gcry_cipher_hd_t aes;
+
+  /**
+   * TWOFISH handle, keyed with the TWOFISH half of @e key.
+   */
+  gcry_cipher_hd_t twofish;
+
+  /**
+   * Session key the handles are currently set up for.
+   */
+  struct GNUNET_CRYPTO_SymmetricSessionKey key;
+
+};
+
+
+/**
+ * Load @a sessionkey into both cipher handles of @a ctx.
+ *
+ * @param ctx context to update
+ * @param sessionkey key to load
+ */
+static void
+context_setkey (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  int rc;
+
+  rc = gcry_cipher_setkey (ctx->aes,
+                           sessionkey->aes_key,
+                           sizeof (sessionkey->aes_key));
+  GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
+  rc = gcry_cipher_setkey (ctx->twofish,
+                           sessionkey->twofish_key,
+                           sizeof (sessionkey->twofish_key));
+  GNUNET_assert ((0 == rc) || ((char) rc == GPG_ERR_WEAK_KEY));
+  ctx->key = *sessionkey;
+}
+
+
+/**
+ * Create a symmetric cipher context for the given session key.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free using #GNUNET_CRYPTO_symmetric_context_destroy()
+ */
+struct GNUNET_CRYPTO_SymmetricContext *
+GNUNET_CRYPTO_symmetric_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  struct GNUNET_CRYPTO_SymmetricContext *ctx;
+
+  ctx = GNUNET_new (struct GNUNET_CRYPTO_SymmetricContext);
+  GNUNET_assert (0 ==
+                 gcry_cipher_open (&ctx->aes, GCRY_CIPHER_AES256,
+                                   GCRY_CIPHER_MODE_CFB, 0));
+  GNUNET_assert (0 ==
+                 gcry_cipher_open (&ctx->twofish, GCRY_CIPHER_TWOFISH,
+                                   GCRY_CIPHER_MODE_CFB, 0));
+  context_setkey (ctx, sessionkey);
+  return ctx;
+}
+
+
+/**
+ * Change the session key of a symmetric cipher context.  Does
+ * nothing if @a sessionkey matches the key already in use.
+ *
+ * @param ctx the context to update
+ * @param sessionkey the new key
+ */
+void
+GNUNET_CRYPTO_symmetric_context_set_key (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  if (0 == memcmp (&ctx->key,
+                   sessionkey,
+                   sizeof (struct GNUNET_CRYPTO_SymmetricSessionKey)))
+    return;
+  context_setkey (ctx, sessionkey);
+}
+
+
+/**
+ * Encrypt a block using a symmetric cipher context.  The
+ * cipher runs in place on @a result, so no temporary copy
+ * of the message is needed.
+ *
+ * @param ctx the context to use
+ * @param block the block to encrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same as
+ *        or overlap with @a block
+ * @return the size of the encrypted block, -1 for errors
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_encrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result)
+{
+  if (result != block)
+    memmove (result, block, size);
+  GNUNET_assert (0 == gcry_cipher_setiv (ctx->aes,
+                                         iv->aes_iv,
+                                         sizeof (iv->aes_iv)));
+  GNUNET_assert (0 == gcry_cipher_encrypt (ctx->aes, result, size, NULL, 0));
+  GNUNET_assert (0 == gcry_cipher_setiv (ctx->twofish,
+                                         iv->twofish_iv,
+                                         sizeof (iv->twofish_iv)));
+  GNUNET_assert (0 == gcry_cipher_encrypt (ctx->twofish, result, size, NULL, 0));
+  return size;
+}
+
+
+/**
+ * Decrypt a block using a symmetric cipher context.  The
+ * cipher runs in place on @a result, so no temporary copy
+ * of the message is needed.
+ *
+ * @param ctx the context to use
+ * @param block the data to decrypt
+ * @param size the size of the @a block
+ * @param iv the initialization vector to use
+ * @param result where to store the result, may be the same as
+ *        or overlap with @a block
+ * @return -1 on failure, size of decrypted block on success
+ */
+ssize_t
+GNUNET_CRYPTO_symmetric_context_decrypt (struct GNUNET_CRYPTO_SymmetricContext *ctx,
+                                         const void *block,
+                                         size_t size,
+                                         const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv,
+                                         void *result)
+{
+  if (result != block)
+    memmove (result, block, size);
+  GNUNET_assert (0 == gcry_cipher_setiv (ctx->twofish,
+                                         iv->twofish_iv,
+                                         sizeof (iv->twofish_iv)));
+  GNUNET_assert (0 == gcry_cipher_decrypt (ctx->twofish, result, size, NULL, 0));
+  GNUNET_assert (0 == gcry_cipher_setiv (ctx->aes,
+                                         iv->aes_iv,
+                                         sizeof (iv->aes_iv)));
+  GNUNET_assert (0 == gcry_cipher_decrypt (ctx->aes, result, size, NULL, 0));
+  return size;
+}
+
+
+/**
+ * Destroy a symmetric cipher context, wiping the key material.
+ *
+ * @param ctx the context to destroy
+ */
+void
+GNUNET_CRYPTO_symmetric_context_destroy (struct GNUNET_CRYPTO_SymmetricContext *ctx)
+{
+  gcry_cipher_close (ctx->aes);
+  gcry_cipher_close (ctx->twofish);
+  memset (&ctx->key, 0, sizeof (ctx->key));
+  GNUNET_free (ctx);
+}
+
+
+/**
+ * Keyed AEAD context for authenticated encryption of many
+ * messages under the same session key.
+ */
+struct GNUNET_CRYPTO_AeadContext
+{
+
+  /**
+   * AES-GCM handle, keyed with the AES half of @e key.
+   */
+  gcry_cipher_hd_t gcm;
+
+  /**
+   * Session key the handle is currently set up for.
+   */
+  struct GNUNET_CRYPTO_SymmetricSessionKey key;
+
+};
+
+
+/**
+ * Create an AEAD context (AES-256-GCM) for the given session key.
+ * Only the AES half of the session key is used.
+ *
+ * @param sessionkey the key to use
+ * @return the context, free using #GNUNET_CRYPTO_aead_context_destroy()
+ */
+struct GNUNET_CRYPTO_AeadContext *
+GNUNET_CRYPTO_aead_context_create (const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  struct GNUNET_CRYPTO_AeadContext *ctx;
+
+  ctx = GNUNET_new (struct GNUNET_CRYPTO_AeadContext);
+  GNUNET_assert (0 ==
+                 gcry_cipher_open (&ctx->gcm, GCRY_CIPHER_AES256,
+                                   GCRY_CIPHER_MODE_GCM, 0));
+  GNUNET_assert (0 ==
+                 gcry_cipher_setkey (ctx->gcm,
+                                     sessionkey->aes_key,
+                                     sizeof (sessionkey->aes_key)));
+  ctx->key = *sessionkey;
+  return ctx;
+}
+
+
+/**
+ * Change the session key of an AEAD context.  Does nothing if
+ * @a sessionkey matches the key already in use.
+ *
+ * @param ctx the context to update
+ * @param sessionkey the new key
+ */
+void
+GNUNET_CRYPTO_aead_context_set_key (struct GNUNET_CRYPTO_AeadContext *ctx,
+                                    const struct GNUNET_CRYPTO_SymmetricSessionKey *sessionkey)
+{
+  if (0 == memcmp (&ctx->key,
+                   sessionkey,
+                   sizeof (struct GNUNET_CRYPTO_SymmetricSessionKey)))
+    return;
+  GNUNET_assert (0 ==
+                 gcry_cipher_setkey (ctx->gcm,
+                                     sessionkey->aes_key,
+                                     sizeof (sessionkey->aes_key)));
+  ctx->key = *sessionkey;
+}
+
+
+/**
+ * Load @a nonce and @a aad into the GCM handle of @a ctx.
+ *
+ * @param ctx context to prepare
+ * @param nonce #GNUNET_CRYPTO_AEAD_NONCE_LENGTH bytes of nonce
+ * @param aad additional data to authenticate
+ * @param aad_size number of bytes in @a aad
+ */
+static void
+aead_start (struct GNUNET_CRYPTO_AeadContext *ctx,
+            const void *nonce,
+            const void *aad,
+            size_t aad_size)
+{
+  GNUNET_assert (0 == gcry_cipher_setiv (ctx->gcm,
+                                         nonce,
+                                         GNUNET_CRYPTO_AEAD_NONCE_LENGTH));
+  if (0 != aad_size)
+    GNUNET_assert (0 == gcry_cipher_authenticate (ctx->gcm,
+                                                  aad,
+                                                  aad_size));
+  GNUNET_assert (0 == gcry_cipher_final (ctx->gcm));
+}
+
+
+/**
+ * Encrypt and authenticate a block in place.  The caller must
+ * never use the same @a nonce twice with the same key.
+ *
+ * @param ctx the context to use
+ * @param nonce #GNUNET_CRYPTO_AEAD_NONCE_LENGTH bytes of nonce
+ * @param aad additional data to authenticate (not encrypted)
+ * @param aad_size number of bytes in @a aad
+ * @param block the block to encrypt in place
+ * @param size the size of the @a block
+ * @param tag where to store the #GNUNET_CRYPTO_AEAD_TAG_LENGTH
+ *        bytes of the authentication tag
+ */
+void
+GNUNET_CRYPTO_aead_encrypt (struct GNUNET_CRYPTO_AeadContext *ctx,
+                            const void *nonce,
+                            const void *aad,
+                            size_t aad_size,
+                            void *block,
+                            size_t size,
+                            void *tag)
+{
+  aead_start (ctx, nonce, aad, aad_size);
+  GNUNET_assert (0 == gcry_cipher_encrypt (ctx->gcm, block, size, NULL, 0));
+  GNUNET_assert (0 == gcry_cipher_gettag (ctx->gcm,
+                                          tag,
+                                          GNUNET_CRYPTO_AEAD_TAG_LENGTH));
+}
+
+
+/**
+ * Verify and decrypt a block in place.
+ *
+ * @param ctx the context to use
+ * @param nonce #GNUNET_CRYPTO_AEAD_NONCE_LENGTH bytes of nonce
+ * @param aad additional data that was authenticated
+ * @param aad_size number of bytes in @a aad
+ * @param block the block to decrypt in place
+ * @param size the size of the @a block
+ * @param tag the #GNUNET_CRYPTO_AEAD_TAG_LENGTH bytes of the
+ *        authentication tag
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a block or
+ *         @a aad were not authentic (@a block is garbage then)
+ */
+int
+GNUNET_CRYPTO_aead_decrypt (struct GNUNET_CRYPTO_AeadContext *ctx,
+                            const void *nonce,
+                            const void *aad,
+                            size_t aad_size,
+                            void *block,
+                            size_t size,
+                            const void *tag)
+{
+  aead_start (ctx, nonce, aad, aad_size);
+  GNUNET_assert (0 == gcry_cipher_decrypt (ctx->gcm, block, size, NULL, 0));
+  if (0 != gcry_cipher_checktag (ctx->gcm,
+                                 tag,
+                                 GNUNET_CRYPTO_AEAD_TAG_LENGTH))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Destroy an AEAD context, wiping the key material.
+ *
+ * @param ctx the context to destroy
+ */
+void
+GNUNET_CRYPTO_aead_context_destroy (struct GNUNET_CRYPTO_AeadContext *ctx)
+{
+  gcry_cipher_close (ctx->gcm);
+  memset (&ctx->key, 0, sizeof (ctx->key));
+  GNUNET_free (ctx);
+}
+
+
 /**
  * @brief Derive an IV
  *
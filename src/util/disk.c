@@ -27,6 +27,7 @@
 #include "disk.h"
 #include "gnunet_strings_lib.h"
 #include "gnunet_disk_lib.h"
+#include "gnunet_crypto_lib.h"
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
@@ -40,6 +41,9 @@
 #define COPY_BLK_SIZE 65536
 
 #include <sys/types.h>
+#ifndef MINGW
+#include <sys/uio.h>
+#endif
 #if HAVE_SYS_VFS_H
 #include <sys/vfs.h>
 #endif
@@ -1093,6 +1097,85 @@ GNUNET_DISK_file_write (const struct GNUNET_DISK_FileHandle * h,
 }
 
 
+/**
+ * Write data from several buffers with a single call.  The
+ * buffers are written in order, as if they were one contiguous
+ * buffer.
+ *
+ * @param h handle to open file
+ * @param buffers data to write
+ * @param lengths number of bytes in each of the @a buffers
+ * @param count number of entries in @a buffers and @a lengths
+ * @return number of bytes written on success, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_DISK_file_writev (const struct GNUNET_DISK_FileHandle *h,
+                         const void *const *buffers,
+                         const size_t *lengths,
+                         unsigned int count)
+{
+#ifndef MINGW
+  struct iovec iov[count];
+  unsigned int i;
+
+  if (NULL == h)
+  {
+    errno = EINVAL;
+    return GNUNET_SYSERR;
+  }
+  for (i = 0; i < count; i++)
+  {
+    iov[i].iov_base = (void *) buffers[i];
+    iov[i].iov_len = lengths[i];
+  }
+  return writev (h->fd, iov, count);
+#else
+  ssize_t total;
+  ssize_t ret;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < count; i++)
+  {
+    ret = GNUNET_DISK_file_write (h,
+                                  buffers[i],
+                                  lengths[i]);
+    if (-1 == ret)
+      return (0 == total) ? GNUNET_SYSERR : total;
+    total += ret;
+    if (ret < lengths[i])
+      break;
+  }
+  return total;
+#endif
+}
+
+
+/**
+ * Ask the kernel to use a buffer of @a size bytes for the pipe
+ * of the given handle.
+ *
+ * @param h handle to either end of a pipe
+ * @param size desired capacity of the pipe in bytes
+ * @return #GNUNET_OK on success, #GNUNET_NO if not supported
+ *         on this platform, #GNUNET_SYSERR on error
+ */
+int
+GNUNET_DISK_pipe_set_size (const struct GNUNET_DISK_FileHandle *h,
+                           size_t size)
+{
+#if defined(F_SETPIPE_SZ) && !defined(MINGW)
+  if (-1 == fcntl (h->fd,
+                   F_SETPIPE_SZ,
+                   (int) size))
+    return GNUNET_SYSERR;
+  return GNUNET_OK;
+#else
+  return GNUNET_NO;
+#endif
+}
+
+
 /**
  * Write a buffer to a file, blocking, if necessary.
  *
@@ -2018,6 +2101,34 @@ GNUNET_DISK_file_unmap (struct GNUNET_DISK_MapHandle *h)
 }
 
 
+/**
+ * Write changes to a mapped file region to disk
+ *
+ * @param h mapping handle
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR otherwise
+ */
+int
+GNUNET_DISK_file_map_sync (const struct GNUNET_DISK_MapHandle *h)
+{
+  if (h == NULL)
+  {
+    errno = EINVAL;
+    return GNUNET_SYSERR;
+  }
+
+#ifdef MINGW
+  int ret;
+
+  ret = FlushViewOfFile (h->addr, 0) ? GNUNET_OK : GNUNET_SYSERR;
+  if (ret != GNUNET_OK)
+    SetErrnoFromWinError (GetLastError ());
+  return ret;
+#else
+  return msync (h->addr, h->len, MS_SYNC) == -1 ? GNUNET_SYSERR : GNUNET_OK;
+#endif
+}
+
+
 /**
  * Write file changes to disk
  * @param h handle to an open file
@@ -2047,6 +2158,319 @@ GNUNET_DISK_file_sync (const struct GNUNET_DISK_FileHandle *h)
 }
 
 
+/**
+ * Kind of an asynchronous disk operation.
+ */
+enum AsyncType
+{
+  ASYNC_READ,
+  ASYNC_WRITE,
+  ASYNC_SYNC
+};
+
+
+/**
+ * Handle for an asynchronous disk operation.
+ */
+struct GNUNET_DISK_AsyncOperation
+{
+  /**
+   * Job in the offload pool.
+   */
+  struct GNUNET_CRYPTO_OffloadJob *job;
+
+  /**
+   * File we operate on.
+   */
+  const struct GNUNET_DISK_FileHandle *fh;
+
+  /**
+   * Buffer to read into or write from, NULL for sync.
+   */
+  void *buf;
+
+  /**
+   * Size of @e buf.
+   */
+  size_t len;
+
+  /**
+   * Position in the file.
+   */
+  off_t offset;
+
+  /**
+   * Function to call on completion.
+   */
+  GNUNET_DISK_AsyncCallback cb;
+
+  /**
+   * Closure for @e cb.
+   */
+  void *cb_cls;
+
+  /**
+   * Number of bytes transferred, -1 on error.
+   */
+  ssize_t result;
+
+  /**
+   * errno of the operation if @e result is -1.
+   */
+  int error;
+
+  /**
+   * What we do.
+   */
+  enum AsyncType type;
+};
+
+
+/**
+ * Transfer up to @a len bytes at @a offset without touching the
+ * file position.
+ *
+ * @param op operation to run
+ * @param buf buffer to use
+ * @param len number of bytes left
+ * @param offset where to read or write
+ * @return number of bytes transferred, -1 on error, 0 on EOF
+ */
+static ssize_t
+async_transfer (struct GNUNET_DISK_AsyncOperation *op,
+                char *buf,
+                size_t len,
+                off_t offset)
+{
+#ifdef MINGW
+  OVERLAPPED ov;
+  DWORD done;
+  BOOL ok;
+
+  memset (&ov, 0, sizeof (ov));
+  ov.Offset = (DWORD) (((uint64_t) offset) & 0xFFFFFFFF);
+  ov.OffsetHigh = (DWORD) (((uint64_t) offset) >> 32);
+  if (len > 0x7FFFFFFF)
+    len = 0x7FFFFFFF;
+  if (ASYNC_READ == op->type)
+    ok = ReadFile (op->fh->h, buf, (DWORD) len, &done, &ov);
+  else
+    ok = WriteFile (op->fh->h, buf, (DWORD) len, &done, &ov);
+  if (! ok)
+  {
+    if (ERROR_HANDLE_EOF == GetLastError ())
+      return 0;
+    SetErrnoFromWinError (GetLastError ());
+    return -1;
+  }
+  return done;
+#else
+  if (ASYNC_READ == op->type)
+    return pread (op->fh->fd, buf, len, offset);
+  return pwrite (op->fh->fd, buf, len, offset);
+#endif
+}
+
+
+/**
+ * Run an asynchronous disk operation.  Called from a worker
+ * thread, so it must not log.
+ *
+ * @param cls the `struct GNUNET_DISK_AsyncOperation`
+ * @return #GNUNET_OK
+ */
+static int
+async_run (void *cls)
+{
+  struct GNUNET_DISK_AsyncOperation *op = cls;
+  size_t pos;
+  ssize_t ret;
+
+  if (ASYNC_SYNC == op->type)
+  {
+    if (GNUNET_OK == GNUNET_DISK_file_sync (op->fh))
+      op->result = 0;
+    else
+    {
+      op->error = errno;
+      op->result = -1;
+    }
+    return GNUNET_OK;
+  }
+  /* loop over short transfers, so that reads only come up
+     short at the end of the file and writes never do */
+  pos = 0;
+  while (pos < op->len)
+  {
+    ret = async_transfer (op,
+                          &((char *) op->buf)[pos],
+                          op->len - pos,
+                          op->offset + (off_t) pos);
+    if ( (-1 == ret) &&
+         (EINTR == errno) )
+      continue;
+    if (-1 == ret)
+    {
+      op->error = errno;
+      op->result = -1;
+      return GNUNET_OK;
+    }
+    if (0 == ret)
+      break;
+    pos += ret;
+  }
+  op->result = pos;
+  return GNUNET_OK;
+}
+
+
+/**
+ * An asynchronous disk operation is done, report the result.
+ *
+ * @param cls the `struct GNUNET_DISK_AsyncOperation`
+ * @param result unused
+ */
+static void
+async_done (void *cls,
+            int result)
+{
+  struct GNUNET_DISK_AsyncOperation *op = cls;
+
+  errno = op->error;
+  op->cb (op->cb_cls, op->result);
+  GNUNET_free (op);
+}
+
+
+/**
+ * Start an asynchronous disk operation.
+ *
+ * @param type what to do
+ * @param h file to operate on
+ * @param buf buffer to use
+ * @param len size of @a buf
+ * @param offset position in the file
+ * @param cb function to call on completion
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+static struct GNUNET_DISK_AsyncOperation *
+async_start (enum AsyncType type,
+             const struct GNUNET_DISK_FileHandle *h,
+             void *buf,
+             size_t len,
+             off_t offset,
+             GNUNET_DISK_AsyncCallback cb,
+             void *cb_cls)
+{
+  struct GNUNET_DISK_AsyncOperation *op;
+
+  if ( (NULL == h) ||
+       (offset < 0) )
+  {
+    errno = EINVAL;
+    return NULL;
+  }
+  op = GNUNET_new (struct GNUNET_DISK_AsyncOperation);
+  op->type = type;
+  op->fh = h;
+  op->buf = buf;
+  op->len = len;
+  op->offset = offset;
+  op->cb = cb;
+  op->cb_cls = cb_cls;
+  op->job = GNUNET_CRYPTO_offload (&async_run, op,
+                                   &async_done, op);
+  return op;
+}
+
+
+/**
+ * Read from a file without blocking the main loop.  The read
+ * happens at @a offset in a worker thread; the file position of
+ * @a h is not changed.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param result buffer to read into, must stay valid as well
+ * @param len number of bytes to read
+ * @param offset where in the file to start reading
+ * @param cb function to call with the number of bytes read
+ *        (less than @a len only at the end of the file)
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_read_async (const struct GNUNET_DISK_FileHandle *h,
+                             void *result,
+                             size_t len,
+                             off_t offset,
+                             GNUNET_DISK_AsyncCallback cb,
+                             void *cb_cls)
+{
+  return async_start (ASYNC_READ, h, result, len, offset, cb, cb_cls);
+}
+
+
+/**
+ * Write to a file without blocking the main loop.  The write
+ * happens at @a offset in a worker thread; the file position of
+ * @a h is not changed.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param buffer data to write, must stay valid as well
+ * @param n number of bytes to write
+ * @param offset where in the file to write
+ * @param cb function to call with the number of bytes written
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_write_async (const struct GNUNET_DISK_FileHandle *h,
+                              const void *buffer,
+                              size_t n,
+                              off_t offset,
+                              GNUNET_DISK_AsyncCallback cb,
+                              void *cb_cls)
+{
+  return async_start (ASYNC_WRITE, h, (void *) buffer, n, offset, cb, cb_cls);
+}
+
+
+/**
+ * Write file changes to disk without blocking the main loop.
+ *
+ * @param h handle to an open file, must stay open until @a cb
+ *        was called or the operation was cancelled
+ * @param cb function to call with 0 on success, -1 on error
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the operation, NULL on error
+ */
+struct GNUNET_DISK_AsyncOperation *
+GNUNET_DISK_file_sync_async (const struct GNUNET_DISK_FileHandle *h,
+                             GNUNET_DISK_AsyncCallback cb,
+                             void *cb_cls)
+{
+  return async_start (ASYNC_SYNC, h, NULL, 0, 0, cb, cb_cls);
+}
+
+
+/**
+ * Cancel an asynchronous disk operation.  Its callback will not
+ * be called.  If the operation is running right now, waits for it
+ * to finish, so that the buffer can be released afterwards.
+ *
+ * @param op operation to cancel
+ */
+void
+GNUNET_DISK_async_cancel (struct GNUNET_DISK_AsyncOperation *op)
+{
+  GNUNET_CRYPTO_offload_cancel (op->job);
+  GNUNET_free (op);
+}
+
+
 #if WINDOWS
 #ifndef PIPE_BUF
 #define PIPE_BUF        512
@@ -29,72 +29,248 @@
 #include "gnunet_statistics_service.h"
 #include "resolver.h"
 
+#if HAVE_PTHREAD && !WINDOWS
+#include <pthread.h>
+#define USE_THREADS 1
+#endif
+
+
+/**
+ * Default number of threads doing the (blocking) lookups.
+ */
+#define DEFAULT_THREADS 4
+
+/**
+ * Maximum number of threads doing lookups.
+ */
+#define MAX_THREADS 64
+
+/**
+ * Maximum number of completed lookups we keep in the cache.
+ */
+#define MAX_CACHE_SIZE 1024
+
+
 /**
- * A cached DNS lookup result (for reverse lookup).
+ * A client waiting for the result of a lookup.
  */
-struct IPCache
+struct Waiter
 {
   /**
    * This is a doubly linked list.
    */
-  struct IPCache *next;
+  struct Waiter *next;
 
   /**
    * This is a doubly linked list.
    */
-  struct IPCache *prev;
+  struct Waiter *prev;
+
+  /**
+   * Client to send the result to.
+   */
+  struct GNUNET_SERVER_Client *client;
+};
+
+
+/**
+ * An IP address found for a hostname.
+ */
+struct ResolvedAddress
+{
+  /**
+   * Address family of @e addr.
+   */
+  int af;
+
+  /**
+   * The address.
+   */
+  union
+  {
+    struct in_addr v4;
+    struct in6_addr v6;
+  } addr;
+};
+
+
+/**
+ * A forward or reverse DNS lookup, either in progress or cached.
+ * While a lookup is @e pending, only the thread resolving it may
+ * touch the request and result fields.
+ */
+struct Lookup
+{
+  /**
+   * Key of this lookup in #lookup_map.
+   */
+  struct GNUNET_HashCode key;
+
+  /**
+   * Clients waiting for the result.
+   */
+  struct Waiter *waiter_head;
 
   /**
-   * Hostname in human-readable form.
+   * Clients waiting for the result.
    */
-  char *addr;
+  struct Waiter *waiter_tail;
 
   /**
-   * Binary IP address, allocated at the end of this struct.
+   * Next lookup in the work or done queue of the threads.
+   */
+  struct Lookup *job_next;
+
+  /**
+   * Entry in #cache_heap, NULL while the lookup is pending.
+   */
+  struct GNUNET_CONTAINER_HeapNode *hn;
+
+  /**
+   * Hostname to resolve (forward lookups only).
+   */
+  char *hostname;
+
+  /**
+   * Binary IP address, allocated at the end of this struct
+   * (reverse lookups only).
    */
   const void *ip;
 
   /**
-   * Last time this entry was updated.
+   * Hostname found for @e ip (reverse lookups only), NULL on error.
+   */
+  char *name;
+
+  /**
+   * Addresses found for @e hostname (forward lookups only).
+   */
+  struct ResolvedAddress *addrs;
+
+  /**
+   * Error message of the system resolver (a static string), or NULL.
    */
-  struct GNUNET_TIME_Absolute last_refresh;
+  const char *error;
 
   /**
-   * Last time this entry was requested.
+   * When does the cached result expire?
    */
-  struct GNUNET_TIME_Absolute last_request;
+  struct GNUNET_TIME_Absolute expiration;
 
   /**
-   * Number of bytes in ip.
+   * Number of bytes in @e ip.
    */
   size_t ip_len;
 
   /**
-   * Address family of the IP.
+   * Number of entries in @e addrs.
+   */
+  unsigned int num_addrs;
+
+  /**
+   * #GNUNET_YES for reverse lookups (IP to hostname).
+   */
+  int direction;
+
+  /**
+   * Address family requested, AF_INET, AF_INET6 or AF_UNSPEC.
    */
   int af;
+
+  /**
+   * #GNUNET_YES while the lookup is being resolved.
+   */
+  int pending;
 };
 
 
 /**
- * Start of the linked list of cached DNS lookup results.
+ * Map of all lookups (hash of the request to `struct Lookup`).
+ */
+static struct GNUNET_CONTAINER_MultiHashMap *lookup_map;
+
+/**
+ * Completed lookups by expiration time.
+ */
+static struct GNUNET_CONTAINER_Heap *cache_heap;
+
+/**
+ * How long do we cache successful lookups?
+ */
+static struct GNUNET_TIME_Relative cache_ttl;
+
+/**
+ * How long do we cache failed lookups?
+ */
+static struct GNUNET_TIME_Relative negative_ttl;
+
+#if USE_THREADS
+/**
+ * Number of threads doing lookups, 0 to resolve in the main thread.
+ */
+static unsigned int num_threads;
+
+/**
+ * Protects the work and done queues and #stop_threads.
+ */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Serializes calls to non-reentrant resolver functions.
+ */
+static pthread_mutex_t legacy_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Signalled when there is work for the threads.
+ */
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Lookups waiting for a thread.
+ */
+static struct Lookup *work_head;
+
+/**
+ * Lookups waiting for a thread.
+ */
+static struct Lookup *work_tail;
+
+/**
+ * Lookups the threads completed.
+ */
+static struct Lookup *done_head;
+
+/**
+ * Set to #GNUNET_YES to make the threads exit.
+ */
+static int stop_threads;
+
+/**
+ * Pipe the threads use to wake up the main thread.
  */
-static struct IPCache *cache_head;
+static struct GNUNET_DISK_PipeHandle *wakeup_pipe;
 
 /**
- * Tail of the linked list of cached DNS lookup results.
+ * Task reading from #wakeup_pipe.
  */
-static struct IPCache *cache_tail;
+static struct GNUNET_SCHEDULER_Task *wakeup_task;
+
+#define LEGACY_LOCK() GNUNET_assert (0 == pthread_mutex_lock (&legacy_lock))
+#define LEGACY_UNLOCK() GNUNET_assert (0 == pthread_mutex_unlock (&legacy_lock))
+#else
+#define LEGACY_LOCK() do {} while (0)
+#define LEGACY_UNLOCK() do {} while (0)
+#endif
 
 
 #if HAVE_GETNAMEINFO
 /**
  * Resolve the given request using getnameinfo
  *
- * @param cache the request to resolve (and where to store the result)
+ * @param lookup the request to resolve (and where to store the result)
  */
 static void
-getnameinfo_resolve (struct IPCache *cache)
+getnameinfo_resolve (struct Lookup *lookup)
 {
   char hostname[256];
   const struct sockaddr *sa;
@@ -103,13 +279,13 @@ getnameinfo_resolve (struct IPCache *cache)
   size_t salen;
   int ret;
 
-  switch (cache->af)
+  switch (lookup->af)
   {
   case AF_INET:
-    GNUNET_assert (cache->ip_len == sizeof (struct in_addr));
+    GNUNET_assert (lookup->ip_len == sizeof (struct in_addr));
     sa = (const struct sockaddr*) &v4;
     memset (&v4, 0, sizeof (v4));
-    v4.sin_addr = * (const struct in_addr*) cache->ip;
+    v4.sin_addr = * (const struct in_addr*) lookup->ip;
     v4.sin_family = AF_INET;
 #if HAVE_SOCKADDR_IN_SIN_LEN
     v4.sin_len = sizeof (v4);
@@ -117,10 +293,10 @@ getnameinfo_resolve (struct IPCache *cache)
     salen = sizeof (v4);
     break;
   case AF_INET6:
-    GNUNET_assert (cache->ip_len == sizeof (struct in6_addr));
+    GNUNET_assert (lookup->ip_len == sizeof (struct in6_addr));
     sa = (const struct sockaddr*) &v6;
     memset (&v6, 0, sizeof (v6));
-    v6.sin6_addr = * (const struct in6_addr*) cache->ip;
+    v6.sin6_addr = * (const struct in6_addr*) lookup->ip;
     v6.sin6_family = AF_INET6;
 #if HAVE_SOCKADDR_IN_SIN_LEN
     v6.sin6_len = sizeof (v6);
@@ -136,15 +312,9 @@ getnameinfo_resolve (struct IPCache *cache)
                           hostname, sizeof (hostname),
                           NULL,
                           0, 0)))
-  {
-    cache->addr = GNUNET_strdup (hostname);
-  }
+    lookup->name = GNUNET_strdup (hostname);
   else
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "getnameinfo failed: %s\n",
-                gai_strerror (ret));
-  }
+    lookup->error = gai_strerror (ret);
 }
 #endif
 
@@ -153,148 +323,56 @@ getnameinfo_resolve (struct IPCache *cache)
 /**
  * Resolve the given request using gethostbyaddr
  *
- * @param cache the request to resolve (and where to store the result)
+ * @param lookup the request to resolve (and where to store the result)
  */
 static void
-gethostbyaddr_resolve (struct IPCache *cache)
+gethostbyaddr_resolve (struct Lookup *lookup)
 {
   struct hostent *ent;
 
-  ent = gethostbyaddr (cache->ip,
-		       cache->ip_len,
-		       cache->af);
+  LEGACY_LOCK ();
+  ent = gethostbyaddr (lookup->ip,
+		       lookup->ip_len,
+		       lookup->af);
   if (NULL != ent)
-  {
-    cache->addr = GNUNET_strdup (ent->h_name);
-  }
+    lookup->name = GNUNET_strdup (ent->h_name);
   else
-  {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                "gethostbyaddr failed: %s\n",
-                hstrerror (h_errno));
-  }
+    lookup->error = hstrerror (h_errno);
+  LEGACY_UNLOCK ();
 }
 #endif
 
 
 /**
- * Resolve the given request using the available methods.
+ * Add an address to the result of a forward lookup.
  *
- * @param cache the request to resolve (and where to store the result)
+ * @param lookup the lookup to update
+ * @param af address family of @a addr
+ * @param addr a `struct in_addr` or `struct in6_addr`
  */
 static void
-cache_resolve (struct IPCache *cache)
+add_address (struct Lookup *lookup,
+             int af,
+             const void *addr)
 {
-#if HAVE_GETNAMEINFO
-  if (NULL == cache->addr)
-    getnameinfo_resolve (cache);
-#endif
-#if HAVE_GETHOSTBYADDR
-  if (NULL == cache->addr)
-    gethostbyaddr_resolve (cache);
-#endif
-}
+  struct ResolvedAddress ra;
 
-
-/**
- * Get an IP address as a string (works for both IPv4 and IPv6).  Note
- * that the resolution happens asynchronously and that the first call
- * may not immediately result in the FQN (but instead in a
- * human-readable IP address).
- *
- * @param client handle to the client making the request (for sending the reply)
- * @param af AF_INET or AF_INET6
- * @param ip `struct in_addr` or `struct in6_addr`
- */
-static void
-get_ip_as_string (struct GNUNET_SERVER_Client *client,
-                  int af,
-		  const void *ip)
-{
-  struct IPCache *pos;
-  struct IPCache *next;
-  struct GNUNET_TIME_Absolute now;
-  struct GNUNET_SERVER_TransmitContext *tc;
-  size_t ip_len;
-  struct in6_addr ix;
-
-  switch (af)
-  {
-  case AF_INET:
-    ip_len = sizeof (struct in_addr);
-    break;
-  case AF_INET6:
-    ip_len = sizeof (struct in6_addr);
-    break;
-  default:
-    GNUNET_assert (0);
-  }
-  now = GNUNET_TIME_absolute_get ();
-  next = cache_head;
-  while ( (NULL != (pos = next)) &&
-	  ( (pos->af != af) ||
-	    (pos->ip_len != ip_len) ||
-	    (0 != memcmp (pos->ip, ip, ip_len))) )
-  {
-    next = pos->next;
-    if (GNUNET_TIME_absolute_get_duration (pos->last_request).rel_value_us <
-        60 * 60 * 1000 * 1000LL)
-    {
-      GNUNET_CONTAINER_DLL_remove (cache_head,
-				   cache_tail,
-				   pos);
-      GNUNET_free_non_null (pos->addr);
-      GNUNET_free (pos);
-      continue;
-    }
-  }
-  if (NULL != pos)
-  {
-    if ( (1 == inet_pton (af,
-                          pos->ip,
-                          &ix)) &&
-         (GNUNET_TIME_absolute_get_duration (pos->last_request).rel_value_us >
-          120 * 1000 * 1000LL) )
-    {
-      /* try again if still numeric AND 2 minutes have expired */
-      GNUNET_free_non_null (pos->addr);
-      pos->addr = NULL;
-      cache_resolve (pos);
-      pos->last_request = now;
-    }
-  }
+  memset (&ra, 0, sizeof (ra));
+  ra.af = af;
+  if (AF_INET == af)
+    ra.addr.v4 = * (const struct in_addr *) addr;
   else
-  {
-    pos = GNUNET_malloc (sizeof (struct IPCache) + ip_len);
-    pos->ip = &pos[1];
-    memcpy (&pos[1], ip, ip_len);
-    pos->last_request = now;
-    pos->last_refresh = now;
-    pos->ip_len = ip_len;
-    pos->af = af;
-    GNUNET_CONTAINER_DLL_insert (cache_head,
-				 cache_tail,
-				 pos);
-    cache_resolve (pos);
-  }
-  tc = GNUNET_SERVER_transmit_context_create (client);
-  if (NULL != pos->addr)
-    GNUNET_SERVER_transmit_context_append_data (tc, pos->addr,
-                                                strlen (pos->addr) + 1,
-                                                GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
-  else
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-                "Reverse lookup failed\n");
-  GNUNET_SERVER_transmit_context_append_data (tc, NULL, 0,
-                                              GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
-  GNUNET_SERVER_transmit_context_run (tc, GNUNET_TIME_UNIT_FOREVER_REL);
+    ra.addr.v6 = * (const struct in6_addr *) addr;
+  GNUNET_array_append (lookup->addrs,
+                       lookup->num_addrs,
+                       ra);
 }
 
 
 #if HAVE_GETADDRINFO
 static int
-getaddrinfo_resolve (struct GNUNET_SERVER_TransmitContext *tc,
-                     const char *hostname, int af)
+getaddrinfo_resolve (struct Lookup *lookup,
+                     int af)
 {
   int s;
   struct addrinfo hints;
@@ -307,8 +385,8 @@ getaddrinfo_resolve (struct GNUNET_SERVER_TransmitContext *tc,
   {
     int ret1;
     int ret2;
-    ret1 = getaddrinfo_resolve (tc, hostname, AF_INET);
-    ret2 = getaddrinfo_resolve (tc, hostname, AF_INET6);
+    ret1 = getaddrinfo_resolve (lookup, AF_INET);
+    ret2 = getaddrinfo_resolve (lookup, AF_INET6);
     if ((ret1 == GNUNET_OK) || (ret2 == GNUNET_OK))
       return GNUNET_OK;
     if ((ret1 == GNUNET_SYSERR) || (ret2 == GNUNET_SYSERR))
@@ -321,14 +399,9 @@ getaddrinfo_resolve (struct GNUNET_SERVER_TransmitContext *tc,
   hints.ai_family = af;
   hints.ai_socktype = SOCK_STREAM;      /* go for TCP */
 
-  if (0 != (s = getaddrinfo (hostname, NULL, &hints, &result)))
+  if (0 != (s = getaddrinfo (lookup->hostname, NULL, &hints, &result)))
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                _("Could not resolve `%s' (%s): %s\n"),
-                hostname,
-                (af ==
-                 AF_INET) ? "IPv4" : ((af == AF_INET6) ? "IPv6" : "any"),
-                gai_strerror (s));
+    lookup->error = gai_strerror (s);
     if ((s == EAI_BADFLAGS) || (s == EAI_MEMORY)
 #ifndef WINDOWS
         || (s == EAI_SYSTEM)
@@ -346,16 +419,14 @@ getaddrinfo_resolve (struct GNUNET_SERVER_TransmitContext *tc,
     switch (pos->ai_family)
     {
     case AF_INET:
-      GNUNET_SERVER_transmit_context_append_data (tc,
-						  &((struct sockaddr_in*) pos->ai_addr)->sin_addr,
-						  sizeof (struct in_addr),
-						  GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+      add_address (lookup,
+                   AF_INET,
+                   &((struct sockaddr_in*) pos->ai_addr)->sin_addr);
       break;
     case AF_INET6:
-      GNUNET_SERVER_transmit_context_append_data (tc,
-						  &((struct sockaddr_in6*) pos->ai_addr)->sin6_addr,
-						  sizeof (struct in6_addr),
-						  GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+      add_address (lookup,
+                   AF_INET6,
+                   &((struct sockaddr_in6*) pos->ai_addr)->sin6_addr);
       break;
     default:
       /* unsupported, skip */
@@ -371,8 +442,7 @@ getaddrinfo_resolve (struct GNUNET_SERVER_TransmitContext *tc,
 
 
 static int
-gethostbyname2_resolve (struct GNUNET_SERVER_TransmitContext *tc,
-                        const char *hostname,
+gethostbyname2_resolve (struct Lookup *lookup,
                         int af)
 {
   struct hostent *hp;
@@ -386,20 +456,20 @@ gethostbyname2_resolve (struct GNUNET_SERVER_TransmitContext *tc,
 
   if (af == AF_UNSPEC)
   {
-    ret1 = gethostbyname2_resolve (tc, hostname, AF_INET);
-    ret2 = gethostbyname2_resolve (tc, hostname, AF_INET6);
+    ret1 = gethostbyname2_resolve (lookup, AF_INET);
+    ret2 = gethostbyname2_resolve (lookup, AF_INET6);
     if ((ret1 == GNUNET_OK) || (ret2 == GNUNET_OK))
       return GNUNET_OK;
     if ((ret1 == GNUNET_SYSERR) || (ret2 == GNUNET_SYSERR))
       return GNUNET_SYSERR;
     return GNUNET_NO;
   }
-  hp = gethostbyname2 (hostname, af);
+  LEGACY_LOCK ();
+  hp = gethostbyname2 (lookup->hostname, af);
   if (hp == NULL)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                _("Could not find IP of host `%s': %s\n"), hostname,
-                hstrerror (h_errno));
+    lookup->error = hstrerror (h_errno);
+    LEGACY_UNLOCK ();
     return GNUNET_SYSERR;
   }
   GNUNET_assert (hp->h_addrtype == af);
@@ -407,22 +477,18 @@ gethostbyname2_resolve (struct GNUNET_SERVER_TransmitContext *tc,
   {
   case AF_INET:
     GNUNET_assert (hp->h_length == sizeof (struct in_addr));
-    GNUNET_SERVER_transmit_context_append_data (tc,
-						hp->h_addr_list[0],
-						hp->h_length,
-                                                GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+    add_address (lookup, af, hp->h_addr_list[0]);
     break;
   case AF_INET6:
     GNUNET_assert (hp->h_length == sizeof (struct in6_addr));
-    GNUNET_SERVER_transmit_context_append_data (tc,
-						hp->h_addr_list[0],
-						hp->h_length,
-                                                GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+    add_address (lookup, af, hp->h_addr_list[0]);
     break;
   default:
     GNUNET_break (0);
+    LEGACY_UNLOCK ();
     return GNUNET_SYSERR;
   }
+  LEGACY_UNLOCK ();
   return GNUNET_OK;
 }
 
@@ -430,68 +496,380 @@ gethostbyname2_resolve (struct GNUNET_SERVER_TransmitContext *tc,
 
 
 static int
-gethostbyname_resolve (struct GNUNET_SERVER_TransmitContext *tc,
-                       const char *hostname)
+gethostbyname_resolve (struct Lookup *lookup)
 {
   struct hostent *hp;
 
-  hp = GETHOSTBYNAME (hostname);
+  LEGACY_LOCK ();
+  hp = GETHOSTBYNAME (lookup->hostname);
   if (NULL == hp)
   {
-    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
-                _("Could not find IP of host `%s': %s\n"),
-                hostname,
-                hstrerror (h_errno));
+    lookup->error = hstrerror (h_errno);
+    LEGACY_UNLOCK ();
     return GNUNET_SYSERR;
   }
   if (hp->h_addrtype != AF_INET)
   {
     GNUNET_break (0);
+    LEGACY_UNLOCK ();
     return GNUNET_SYSERR;
   }
   GNUNET_assert (hp->h_length == sizeof (struct in_addr));
-  GNUNET_SERVER_transmit_context_append_data (tc,
-					      hp->h_addr_list[0],
-					      hp->h_length,
-                                              GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+  add_address (lookup, AF_INET, hp->h_addr_list[0]);
+  LEGACY_UNLOCK ();
   return GNUNET_OK;
 }
 #endif
 
 
 /**
- * Convert a string to an IP address.
+ * Resolve the given request using the available methods.  May be
+ * called from a lookup thread, so we must not log or touch anything
+ * but the @a lookup itself.
  *
- * @param client where to send the IP address
- * @param hostname the hostname to resolve
- * @param af AF_INET or AF_INET6; use AF_UNSPEC for "any"
+ * @param lookup the request to resolve (and where to store the result)
  */
 static void
-get_ip_from_hostname (struct GNUNET_SERVER_Client *client,
-                      const char *hostname,
-                      int af)
+do_lookup (struct Lookup *lookup)
 {
   int ret;
-  struct GNUNET_SERVER_TransmitContext *tc;
 
-  tc = GNUNET_SERVER_transmit_context_create (client);
+  if (GNUNET_YES == lookup->direction)
+  {
+#if HAVE_GETNAMEINFO
+    if (NULL == lookup->name)
+      getnameinfo_resolve (lookup);
+#endif
+#if HAVE_GETHOSTBYADDR
+    if (NULL == lookup->name)
+      gethostbyaddr_resolve (lookup);
+#endif
+    return;
+  }
   ret = GNUNET_NO;
 #if HAVE_GETADDRINFO
   if (ret == GNUNET_NO)
-    ret = getaddrinfo_resolve (tc, hostname, af);
+    ret = getaddrinfo_resolve (lookup, lookup->af);
 #elif HAVE_GETHOSTBYNAME2
   if (ret == GNUNET_NO)
-    ret = gethostbyname2_resolve (tc, hostname, af);
+    ret = gethostbyname2_resolve (lookup, lookup->af);
 #elif HAVE_GETHOSTBYNAME
-  if ((ret == GNUNET_NO) && ((af == AF_UNSPEC) || (af == PF_INET)))
-    gethostbyname_resolve (tc, hostname);
+  if ((ret == GNUNET_NO) && ((lookup->af == AF_UNSPEC) || (lookup->af == PF_INET)))
+    gethostbyname_resolve (lookup);
 #endif
+}
+
+
+/**
+ * Send the result of a lookup to a client.
+ *
+ * @param client client to send the result to
+ * @param lookup completed lookup
+ */
+static void
+send_reply (struct GNUNET_SERVER_Client *client,
+            const struct Lookup *lookup)
+{
+  struct GNUNET_SERVER_TransmitContext *tc;
+  unsigned int i;
+
+  tc = GNUNET_SERVER_transmit_context_create (client);
+  if (GNUNET_YES == lookup->direction)
+  {
+    if (NULL != lookup->name)
+      GNUNET_SERVER_transmit_context_append_data (tc, lookup->name,
+                                                  strlen (lookup->name) + 1,
+                                                  GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
+    else
+      GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                  "Reverse lookup failed\n");
+  }
+  for (i = 0; i < lookup->num_addrs; i++)
+    GNUNET_SERVER_transmit_context_append_data (tc,
+                                                &lookup->addrs[i].addr,
+                                                (AF_INET == lookup->addrs[i].af)
+                                                ? sizeof (struct in_addr)
+                                                : sizeof (struct in6_addr),
+                                                GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
   GNUNET_SERVER_transmit_context_append_data (tc, NULL, 0,
                                               GNUNET_MESSAGE_TYPE_RESOLVER_RESPONSE);
   GNUNET_SERVER_transmit_context_run (tc, GNUNET_TIME_UNIT_FOREVER_REL);
 }
 
 
+/**
+ * Release a lookup that is neither pending nor in the cache heap.
+ *
+ * @param lookup lookup to free
+ */
+static void
+free_lookup (struct Lookup *lookup)
+{
+  struct Waiter *w;
+
+  while (NULL != (w = lookup->waiter_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (lookup->waiter_head,
+                                 lookup->waiter_tail,
+                                 w);
+    GNUNET_SERVER_client_drop (w->client);
+    GNUNET_free (w);
+  }
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (lookup_map,
+                                                       &lookup->key,
+                                                       lookup));
+  GNUNET_free_non_null (lookup->hostname);
+  GNUNET_free_non_null (lookup->name);
+  GNUNET_free_non_null (lookup->addrs);
+  GNUNET_free (lookup);
+}
+
+
+/**
+ * A lookup was resolved.  Cache the result and send it to all
+ * clients waiting for it.
+ *
+ * @param lookup the completed lookup
+ */
+static void
+finish_lookup (struct Lookup *lookup)
+{
+  struct Waiter *w;
+  struct in6_addr ix;
+  char ipbuf[INET6_ADDRSTRLEN];
+  int failed;
+
+  lookup->pending = GNUNET_NO;
+  if (NULL != lookup->error)
+    GNUNET_log (GNUNET_ERROR_TYPE_INFO,
+                _("Could not resolve `%s' (%s): %s\n"),
+                (GNUNET_YES == lookup->direction)
+                ? inet_ntop (lookup->af, lookup->ip, ipbuf, sizeof (ipbuf))
+                : lookup->hostname,
+                (lookup->af ==
+                 AF_INET) ? "IPv4" : ((lookup->af == AF_INET6) ? "IPv6" : "any"),
+                lookup->error);
+  if (GNUNET_YES == lookup->direction)
+    /* a numeric result means there was no name (yet) */
+    failed = ( (NULL == lookup->name) ||
+               (1 == inet_pton (lookup->af,
+                                lookup->name,
+                                &ix)) );
+  else
+    failed = (0 == lookup->num_addrs);
+  lookup->expiration
+    = GNUNET_TIME_relative_to_absolute (failed ? negative_ttl : cache_ttl);
+  lookup->hn = GNUNET_CONTAINER_heap_insert (cache_heap,
+                                             lookup,
+                                             lookup->expiration.abs_value_us);
+  while (NULL != (w = lookup->waiter_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (lookup->waiter_head,
+                                 lookup->waiter_tail,
+                                 w);
+    send_reply (w->client, lookup);
+    GNUNET_SERVER_client_drop (w->client);
+    GNUNET_free (w);
+  }
+  while (GNUNET_CONTAINER_heap_get_size (cache_heap) > MAX_CACHE_SIZE)
+  {
+    lookup = GNUNET_CONTAINER_heap_remove_root (cache_heap);
+    lookup->hn = NULL;
+    free_lookup (lookup);
+  }
+}
+
+
+#if USE_THREADS
+/**
+ * Main function of the lookup threads.
+ *
+ * @param cls NULL
+ * @return NULL
+ */
+static void *
+lookup_thread (void *cls)
+{
+  const struct GNUNET_DISK_FileHandle *wakeup;
+  struct Lookup *lookup;
+  char c = 0;
+
+  wakeup = GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                    GNUNET_DISK_PIPE_END_WRITE);
+  GNUNET_assert (0 == pthread_mutex_lock (&queue_lock));
+  while (1)
+  {
+    while ( (NULL == work_head) &&
+            (GNUNET_YES != stop_threads) )
+      GNUNET_assert (0 == pthread_cond_wait (&work_cond, &queue_lock));
+    if (GNUNET_YES == stop_threads)
+      break;
+    lookup = work_head;
+    work_head = lookup->job_next;
+    if (NULL == work_head)
+      work_tail = NULL;
+    GNUNET_assert (0 == pthread_mutex_unlock (&queue_lock));
+    do_lookup (lookup);
+    GNUNET_assert (0 == pthread_mutex_lock (&queue_lock));
+    lookup->job_next = done_head;
+    done_head = lookup;
+    /* if the pipe is full, the main thread has a wakeup pending anyway */
+    (void) GNUNET_DISK_file_write (wakeup, &c, 1);
+  }
+  GNUNET_assert (0 == pthread_mutex_unlock (&queue_lock));
+  return NULL;
+}
+
+
+/**
+ * Task run when lookup threads completed lookups.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+process_done (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  const struct GNUNET_DISK_FileHandle *fh;
+  struct Lookup *lookup;
+  struct Lookup *done;
+  char buf[64];
+
+  wakeup_task = NULL;
+  fh = GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                GNUNET_DISK_PIPE_END_READ);
+  while (0 < GNUNET_DISK_file_read (fh, buf, sizeof (buf)))
+    ;
+  GNUNET_assert (0 == pthread_mutex_lock (&queue_lock));
+  done = done_head;
+  done_head = NULL;
+  GNUNET_assert (0 == pthread_mutex_unlock (&queue_lock));
+  while (NULL != (lookup = done))
+  {
+    done = lookup->job_next;
+    lookup->job_next = NULL;
+    finish_lookup (lookup);
+  }
+  wakeup_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                                fh,
+                                                &process_done,
+                                                NULL);
+}
+#endif
+
+
+/**
+ * Start resolving a lookup, in a lookup thread if we have any.
+ *
+ * @param lookup lookup to resolve, with at least one waiter
+ */
+static void
+start_lookup (struct Lookup *lookup)
+{
+  lookup->pending = GNUNET_YES;
+  GNUNET_free_non_null (lookup->name);
+  lookup->name = NULL;
+  GNUNET_free_non_null (lookup->addrs);
+  lookup->addrs = NULL;
+  lookup->num_addrs = 0;
+  lookup->error = NULL;
+#if USE_THREADS
+  if (0 < num_threads)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&queue_lock));
+    lookup->job_next = NULL;
+    if (NULL == work_tail)
+      work_head = lookup;
+    else
+      work_tail->job_next = lookup;
+    work_tail = lookup;
+    GNUNET_assert (0 == pthread_cond_signal (&work_cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&queue_lock));
+    return;
+  }
+#endif
+  do_lookup (lookup);
+  finish_lookup (lookup);
+}
+
+
+/**
+ * Answer a request from the cache, join a pending lookup for the
+ * same request, or start a new lookup.
+ *
+ * @param client client making the request
+ * @param direction #GNUNET_YES for reverse lookups
+ * @param af AF_INET, AF_INET6 or AF_UNSPEC
+ * @param data hostname (0-terminated) or IP address
+ * @param data_size number of bytes in @a data
+ */
+static void
+handle_lookup (struct GNUNET_SERVER_Client *client,
+               int direction,
+               int af,
+               const void *data,
+               size_t data_size)
+{
+  struct GNUNET_HashCode key;
+  struct Lookup *lookup;
+  struct Waiter *w;
+  char buf[2 * sizeof (int32_t) + data_size];
+  int32_t hdr[2];
+
+  hdr[0] = direction;
+  hdr[1] = af;
+  memcpy (buf, hdr, sizeof (hdr));
+  memcpy (&buf[sizeof (hdr)], data, data_size);
+  GNUNET_CRYPTO_hash (buf, sizeof (buf), &key);
+  lookup = GNUNET_CONTAINER_multihashmap_get (lookup_map, &key);
+  if ( (NULL != lookup) &&
+       (NULL != lookup->hn) )
+  {
+    if (0 != GNUNET_TIME_absolute_get_remaining (lookup->expiration).rel_value_us)
+    {
+      send_reply (client, lookup);
+      return;
+    }
+    /* expired, resolve again */
+    GNUNET_CONTAINER_heap_remove_node (lookup->hn);
+    lookup->hn = NULL;
+  }
+  if (NULL == lookup)
+  {
+    lookup = GNUNET_malloc (sizeof (struct Lookup) +
+                            ((GNUNET_YES == direction) ? data_size : 0));
+    lookup->key = key;
+    lookup->direction = direction;
+    lookup->af = af;
+    if (GNUNET_YES == direction)
+    {
+      lookup->ip = &lookup[1];
+      lookup->ip_len = data_size;
+      memcpy (&lookup[1], data, data_size);
+    }
+    else
+    {
+      lookup->hostname = GNUNET_strdup (data);
+    }
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap_put (lookup_map,
+                                                      &key,
+                                                      lookup,
+                                                      GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  w = GNUNET_new (struct Waiter);
+  w->client = client;
+  GNUNET_SERVER_client_keep (client);
+  GNUNET_CONTAINER_DLL_insert_tail (lookup->waiter_head,
+                                    lookup->waiter_tail,
+                                    w);
+  if (GNUNET_YES != lookup->pending)
+    start_lookup (lookup);
+}
+
+
 /**
  * Handle GET-message.
  *
@@ -539,7 +917,7 @@ handle_get (void *cls,
     GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
                 "Resolver asked to look up `%s'.\n",
                 hostname);
-    get_ip_from_hostname (client, hostname, af);
+    handle_lookup (client, GNUNET_NO, af, hostname, size);
     return;
   }
   ip = &msg[1];
@@ -576,7 +954,106 @@ handle_get (void *cls,
 		"Resolver asked to look up IP address `%s'.\n",
 		inet_ntop (af, ip, buf, sizeof (buf)));
   }
-  get_ip_as_string (client, af, ip);
+  handle_lookup (client, GNUNET_YES, af, ip, size);
+}
+
+
+/**
+ * Free a lookup during shutdown, unless a lookup thread is still
+ * working on it.
+ *
+ * @param cls NULL
+ * @param key unused
+ * @param value the `struct Lookup`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+free_lookup_it (void *cls,
+                const struct GNUNET_HashCode *key,
+                void *value)
+{
+  struct Lookup *lookup = value;
+
+  if (NULL != lookup->hn)
+  {
+    GNUNET_CONTAINER_heap_remove_node (lookup->hn);
+    lookup->hn = NULL;
+  }
+  if (GNUNET_YES == lookup->pending)
+  {
+    /* still owned by a lookup thread, which we do not wait for
+       (the system resolver may block for a long time); just
+       forget about it, the process is about to exit */
+    while (NULL != lookup->waiter_head)
+    {
+      struct Waiter *w = lookup->waiter_head;
+
+      GNUNET_CONTAINER_DLL_remove (lookup->waiter_head,
+                                   lookup->waiter_tail,
+                                   w);
+      GNUNET_SERVER_client_drop (w->client);
+      GNUNET_free (w);
+    }
+    GNUNET_assert (GNUNET_YES ==
+                   GNUNET_CONTAINER_multihashmap_remove (lookup_map,
+                                                         key,
+                                                         lookup));
+    return GNUNET_OK;
+  }
+  free_lookup (lookup);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Task run during shutdown.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+shutdown_task (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct Lookup *lookup;
+
+#if USE_THREADS
+  if (0 < num_threads)
+  {
+    GNUNET_assert (0 == pthread_mutex_lock (&queue_lock));
+    stop_threads = GNUNET_YES;
+    /* lookups no thread picked up yet, or that were completed,
+       are ours again */
+    while (NULL != (lookup = work_head))
+    {
+      work_head = lookup->job_next;
+      lookup->pending = GNUNET_NO;
+    }
+    work_tail = NULL;
+    while (NULL != (lookup = done_head))
+    {
+      done_head = lookup->job_next;
+      lookup->pending = GNUNET_NO;
+    }
+    GNUNET_assert (0 == pthread_cond_broadcast (&work_cond));
+    GNUNET_assert (0 == pthread_mutex_unlock (&queue_lock));
+    /* the pipe stays open, threads still resolving may write to it */
+    if (NULL != wakeup_task)
+    {
+      GNUNET_SCHEDULER_cancel (wakeup_task);
+      wakeup_task = NULL;
+    }
+  }
+#endif
+  GNUNET_CONTAINER_multihashmap_iterate (lookup_map,
+                                         &free_lookup_it,
+                                         NULL);
+  GNUNET_CONTAINER_multihashmap_destroy (lookup_map);
+  lookup_map = NULL;
+  while (NULL != (lookup = GNUNET_CONTAINER_heap_remove_root (cache_heap)))
+    GNUNET_break (0);
+  GNUNET_CONTAINER_heap_destroy (cache_heap);
+  cache_heap = NULL;
 }
 
 
@@ -595,7 +1072,66 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
     {&handle_get, NULL, GNUNET_MESSAGE_TYPE_RESOLVER_REQUEST, 0},
     {NULL, NULL, 0, 0}
   };
+#if USE_THREADS
+  unsigned long long threads;
+  pthread_t thread;
+#endif
+
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "resolver",
+                                           "CACHE_TTL",
+                                           &cache_ttl))
+    cache_ttl = GNUNET_TIME_UNIT_HOURS;
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_time (cfg,
+                                           "resolver",
+                                           "NEGATIVE_CACHE_TTL",
+                                           &negative_ttl))
+    negative_ttl = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES,
+                                                  2);
+  lookup_map = GNUNET_CONTAINER_multihashmap_create (128,
+                                                     GNUNET_NO);
+  cache_heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+#if USE_THREADS
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_get_value_number (cfg,
+                                             "resolver",
+                                             "THREADS",
+                                             &threads))
+    threads = DEFAULT_THREADS;
+  threads = GNUNET_MIN (threads,
+                        MAX_THREADS);
+  if (0 < threads)
+    wakeup_pipe = GNUNET_DISK_pipe (GNUNET_NO,
+                                    GNUNET_NO,
+                                    GNUNET_NO,
+                                    GNUNET_NO);
+  if (NULL != wakeup_pipe)
+  {
+    for (num_threads = 0; num_threads < threads; num_threads++)
+    {
+      if (0 != pthread_create (&thread, NULL, &lookup_thread, NULL))
+      {
+        GNUNET_log_strerror (GNUNET_ERROR_TYPE_WARNING,
+                             "pthread_create");
+        break;
+      }
+      (void) pthread_detach (thread);
+    }
+    if (0 < num_threads)
+      wakeup_task
+        = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                          GNUNET_DISK_pipe_handle (wakeup_pipe,
+                                                                   GNUNET_DISK_PIPE_END_READ),
+                                          &process_done,
+                                          NULL);
+  }
+#endif
   GNUNET_SERVER_add_handlers (server, handlers);
+  GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_FOREVER_REL,
+                                &shutdown_task,
+                                NULL);
 }
 
 
@@ -609,23 +1145,14 @@ run (void *cls, struct GNUNET_SERVER_Handle *server,
 int
 main (int argc, char *const *argv)
 {
-  struct IPCache *pos;
   int ret;
 
   ret =
       (GNUNET_OK ==
        GNUNET_SERVICE_run (argc, argv,
                            "resolver",
-                           GNUNET_SERVICE_OPTION_NONE,
+                           GNUNET_SERVICE_OPTION_STATELESS,
                            &run, NULL)) ? 0 : 1;
-  while (NULL != (pos = cache_head))
-  {
-    GNUNET_CONTAINER_DLL_remove (cache_head,
-				 cache_tail,
-				 pos);
-    GNUNET_free_non_null (pos->addr);
-    GNUNET_free (pos);
-  }
   return ret;
 }
 
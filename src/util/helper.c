@@ -29,6 +29,20 @@
 #include "gnunet_util_lib.h"
 
 
+/**
+ * Maximum number of queued messages we hand to the kernel with
+ * a single write.
+ */
+#define MAX_WRITE_BATCH 64
+
+/**
+ * Capacity we ask the kernel to use for the pipes to and from the
+ * helper.  Packet helpers (vpn, exit, dns) would otherwise block on
+ * the default 64 KiB pipes long before the scheduler gets back to us.
+ */
+#define HELPER_PIPE_SIZE (1024 * 1024)
+
+
 /**
  * Entry in the queue of messages we need to transmit to the helper.
  */
@@ -323,7 +337,8 @@ helper_read (void *cls,
 	     const struct GNUNET_SCHEDULER_TaskContext *tc)
 {
   struct GNUNET_HELPER_Handle *h = cls;
-  char buf[GNUNET_SERVER_MAX_MESSAGE_SIZE] GNUNET_ALIGN;
+  char *buf;
+  size_t size;
   ssize_t t;
 
   h->read_task = NULL;
@@ -334,7 +349,9 @@ helper_read (void *cls,
 						   h->fh_from_helper, &helper_read, h);
     return;
   }
-  t = GNUNET_DISK_file_read (h->fh_from_helper, &buf, sizeof (buf));
+  /* read directly into the tokenizer, avoids copying the messages */
+  buf = GNUNET_SERVER_mst_get_buffer (h->mst, &size);
+  t = GNUNET_DISK_file_read (h->fh_from_helper, buf, size);
   if (t < 0)
   {
     /* On read-error, restart the helper */
@@ -382,7 +399,7 @@ helper_read (void *cls,
   h->read_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
 						 h->fh_from_helper, &helper_read, h);
   if (GNUNET_SYSERR ==
-      GNUNET_SERVER_mst_receive (h->mst, NULL, buf, t, GNUNET_NO, GNUNET_NO))
+      GNUNET_SERVER_mst_receive_buffer (h->mst, NULL, t, GNUNET_NO, GNUNET_NO))
   {
     GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
 		_("Failed to parse inbound message from helper `%s'\n"),
@@ -446,6 +463,18 @@ start_helper (struct GNUNET_HELPER_Handle *h)
   }
   GNUNET_DISK_pipe_close_end (h->helper_out, GNUNET_DISK_PIPE_END_WRITE);
   GNUNET_DISK_pipe_close_end (h->helper_in, GNUNET_DISK_PIPE_END_READ);
+  /* larger pipes are only an optimization (the limit is
+     /proc/sys/fs/pipe-max-size for unprivileged processes) */
+  if ( (GNUNET_SYSERR ==
+        GNUNET_DISK_pipe_set_size (h->fh_to_helper,
+                                   HELPER_PIPE_SIZE)) ||
+       (GNUNET_SYSERR ==
+        GNUNET_DISK_pipe_set_size (h->fh_from_helper,
+                                   HELPER_PIPE_SIZE)) )
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+                "Failed to enlarge pipes of `%s': %s\n",
+                h->binary_name,
+                STRERROR (errno));
   if (NULL != h->mst)
     h->read_task = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
 						   h->fh_from_helper,
@@ -590,7 +619,12 @@ helper_write (void *cls,
 {
   struct GNUNET_HELPER_Handle *h = cls;
   struct GNUNET_HELPER_SendHandle *sh;
-  const char *buf;
+  struct GNUNET_HELPER_SendHandle *done_head;
+  struct GNUNET_HELPER_SendHandle *done_tail;
+  const void *bufs[MAX_WRITE_BATCH];
+  size_t lens[MAX_WRITE_BATCH];
+  unsigned int cnt;
+  size_t msize;
   ssize_t t;
 
   h->write_task = NULL;
@@ -609,10 +643,18 @@ helper_write (void *cls,
 		"Helper write had no work!\n");
     return; /* how did this happen? */
   }
-  buf = (const char*) sh->msg;
-  t = GNUNET_DISK_file_write (h->fh_to_helper,
-			      &buf[sh->wpos],
-			      ntohs (sh->msg->size) - sh->wpos);
+  /* write as many queued messages as we can with one call */
+  cnt = 0;
+  for (; (NULL != sh) && (cnt < MAX_WRITE_BATCH); sh = sh->next)
+  {
+    bufs[cnt] = &((const char *) sh->msg)[sh->wpos];
+    lens[cnt] = ntohs (sh->msg->size) - sh->wpos;
+    cnt++;
+  }
+  t = GNUNET_DISK_file_writev (h->fh_to_helper,
+                               bufs,
+                               lens,
+                               cnt);
   if (-1 == t)
   {
     /* On write-error, restart the helper */
@@ -639,21 +681,42 @@ helper_write (void *cls,
 	      "Transmitted %u bytes to %s\n",
 	      (unsigned int) t,
 	      h->binary_name);
-  sh->wpos += t;
-  if (sh->wpos == ntohs (sh->msg->size))
+  /* move the completed messages out of the queue before calling
+     the continuations, which may modify the queue */
+  done_head = NULL;
+  done_tail = NULL;
+  while ( (t > 0) &&
+          (NULL != (sh = h->sh_head)) )
   {
+    msize = ntohs (sh->msg->size) - sh->wpos;
+    if ((size_t) t < msize)
+    {
+      sh->wpos += t;
+      break;
+    }
+    t -= msize;
+    sh->wpos += msize;
     GNUNET_CONTAINER_DLL_remove (h->sh_head,
 				 h->sh_tail,
 				 sh);
-    if (NULL != sh->cont)
-      sh->cont (sh->cont_cls, GNUNET_YES);
-    GNUNET_free (sh);
+    GNUNET_CONTAINER_DLL_insert_tail (done_head,
+                                      done_tail,
+                                      sh);
   }
   if (NULL != h->sh_head)
     h->write_task = GNUNET_SCHEDULER_add_write_file (GNUNET_TIME_UNIT_FOREVER_REL,
 						     h->fh_to_helper,
 						     &helper_write,
 						     h);
+  while (NULL != (sh = done_head))
+  {
+    GNUNET_CONTAINER_DLL_remove (done_head,
+                                 done_tail,
+                                 sh);
+    if (NULL != sh->cont)
+      sh->cont (sh->cont_cls, GNUNET_YES);
+    GNUNET_free (sh);
+  }
 }
 
 
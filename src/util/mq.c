@@ -28,6 +28,18 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "mq",__VA_ARGS__)
 
+/**
+ * Envelopes for messages of up to this size are allocated from
+ * #envelope_pool, larger ones with malloc().
+ */
+#define ENVELOPE_POOL_MESSAGE_SIZE 256
+
+/**
+ * Maximum number of messages handed to a #GNUNET_MQ_SendBatchImpl
+ * at once.
+ */
+#define MAX_BATCH_MESSAGES GNUNET_CONNECTION_MAX_MESSAGES
+
 
 struct GNUNET_MQ_Envelope
 {
@@ -63,9 +75,36 @@ struct GNUNET_MQ_Envelope
    * Closure for @e send_cb
    */
   void *sent_cls;
+
+  /**
+   * #GNUNET_YES if the envelope was allocated from #envelope_pool.
+   */
+  int pooled;
 };
 
 
+/**
+ * Pool for envelopes of messages of up to #ENVELOPE_POOL_MESSAGE_SIZE
+ * bytes.
+ */
+static struct GNUNET_MemoryPool *envelope_pool;
+
+
+/**
+ * Release the memory of an envelope.
+ *
+ * @param ev envelope to free
+ */
+static void
+envelope_free (struct GNUNET_MQ_Envelope *ev)
+{
+  if (GNUNET_YES == ev->pooled)
+    GNUNET_pool_free (envelope_pool, ev);
+  else
+    GNUNET_free (ev);
+}
+
+
 /**
  * Handle to a message queue.
  */
@@ -88,6 +127,12 @@ struct GNUNET_MQ_Handle
    */
   GNUNET_MQ_SendImpl send_impl;
 
+  /**
+   * Batched implementation of message sending, NULL if
+   * the queue uses @e send_impl.
+   */
+  GNUNET_MQ_SendBatchImpl send_batch_impl;
+
   /**
    * Implementation-dependent queue destruction function
    */
@@ -125,6 +170,18 @@ struct GNUNET_MQ_Handle
    */
   struct GNUNET_MQ_Envelope *current_envelope;
 
+  /**
+   * Messages currently handed to the @e send_batch_impl
+   * (batched queues only).
+   */
+  struct GNUNET_MQ_Envelope *batch_head;
+
+  /**
+   * Messages currently handed to the @e send_batch_impl
+   * (batched queues only).
+   */
+  struct GNUNET_MQ_Envelope *batch_tail;
+
   /**
    * Map of associations, lazily allocated
    */
@@ -135,6 +192,12 @@ struct GNUNET_MQ_Handle
    */
   struct GNUNET_SCHEDULER_Task * continue_task;
 
+  /**
+   * Task that hands the queued messages of a batched
+   * queue to the implementation.
+   */
+  struct GNUNET_SCHEDULER_Task *flush_task;
+
   /**
    * Next id that should be used for the @e assoc_map,
    * initialized lazily to a random value together with
@@ -159,6 +222,16 @@ struct ServerClientSocketState
    * Active transmission request to the client.
    */
   struct GNUNET_SERVER_TransmitHandle* th;
+
+  /**
+   * Messages of the batch we are transmitting.
+   */
+  const struct GNUNET_MessageHeader *msgs[MAX_BATCH_MESSAGES];
+
+  /**
+   * Number of messages in @e msgs.
+   */
+  unsigned int msgs_count;
 };
 
 
@@ -187,6 +260,16 @@ struct ClientConnectionState
    * Active transmission request (or NULL).
    */
   struct GNUNET_CLIENT_TransmitHandle *th;
+
+  /**
+   * Messages of the batch we are transmitting.
+   */
+  const struct GNUNET_MessageHeader *msgs[MAX_BATCH_MESSAGES];
+
+  /**
+   * Number of messages in @e msgs.
+   */
+  unsigned int msgs_count;
 };
 
 
@@ -259,7 +342,63 @@ void
 GNUNET_MQ_discard (struct GNUNET_MQ_Envelope *mqm)
 {
   GNUNET_assert (NULL == mqm->parent_queue);
-  GNUNET_free (mqm);
+  envelope_free (mqm);
+}
+
+
+/**
+ * Hand as many queued messages as fit into one batch to the
+ * implementation of a batched queue.
+ *
+ * @param mq batched message queue with an empty batch
+ */
+static void
+send_batch (struct GNUNET_MQ_Handle *mq)
+{
+  const struct GNUNET_MessageHeader *msgs[MAX_BATCH_MESSAGES];
+  struct GNUNET_MQ_Envelope *ev;
+  unsigned int count;
+  size_t total;
+
+  GNUNET_assert (NULL == mq->batch_head);
+  count = 0;
+  total = 0;
+  while ( (NULL != (ev = mq->envelope_head)) &&
+          (count < MAX_BATCH_MESSAGES) &&
+          ( (0 == count) ||
+            (total + ntohs (ev->mh->size) < GNUNET_SERVER_MAX_MESSAGE_SIZE) ) )
+  {
+    GNUNET_CONTAINER_DLL_remove (mq->envelope_head,
+                                 mq->envelope_tail,
+                                 ev);
+    GNUNET_CONTAINER_DLL_insert_tail (mq->batch_head,
+                                      mq->batch_tail,
+                                      ev);
+    total += ntohs (ev->mh->size);
+    msgs[count++] = ev->mh;
+  }
+  if (0 == count)
+    return;
+  mq->send_batch_impl (mq, msgs, count, mq->impl_state);
+}
+
+
+/**
+ * Task run to flush the messages queued in a batched
+ * queue during the previous task.
+ *
+ * @param cls the message queue
+ * @param tc scheduler context
+ */
+static void
+flush_batch (void *cls,
+             const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_MQ_Handle *mq = cls;
+
+  mq->flush_task = NULL;
+  if (NULL == mq->batch_head)
+    send_batch (mq);
 }
 
 
@@ -278,6 +417,18 @@ GNUNET_MQ_send (struct GNUNET_MQ_Handle *mq,
   GNUNET_assert (NULL == ev->parent_queue);
 
   ev->parent_queue = mq;
+  if (NULL != mq->send_batch_impl)
+  {
+    /* collect everything sent during this task into one batch */
+    GNUNET_CONTAINER_DLL_insert_tail (mq->envelope_head,
+                                      mq->envelope_tail,
+                                      ev);
+    if ( (NULL == mq->batch_head) &&
+         (NULL == mq->flush_task) )
+      mq->flush_task = GNUNET_SCHEDULER_add_now (&flush_batch,
+                                                 mq);
+    return;
+  }
   /* is the implementation busy? queue it! */
   if (NULL != mq->current_envelope)
   {
@@ -310,6 +461,32 @@ impl_send_continue (void *cls,
     return;
 
   mq->continue_task = NULL;
+  if (NULL != mq->send_batch_impl)
+  {
+    struct GNUNET_MQ_Envelope *head;
+    struct GNUNET_MQ_Envelope *tail;
+
+    /* the whole batch is done; detach it before handing out the
+       next one, as the callbacks may destroy the queue */
+    head = mq->batch_head;
+    tail = mq->batch_tail;
+    GNUNET_assert (NULL != head);
+    mq->batch_head = NULL;
+    mq->batch_tail = NULL;
+    for (current_envelope = head;
+         NULL != current_envelope;
+         current_envelope = current_envelope->next)
+      current_envelope->parent_queue = NULL;
+    send_batch (mq);
+    while (NULL != (current_envelope = head))
+    {
+      GNUNET_CONTAINER_DLL_remove (head, tail, current_envelope);
+      if (NULL != current_envelope->sent_cb)
+        current_envelope->sent_cb (current_envelope->sent_cls);
+      envelope_free (current_envelope);
+    }
+    return;
+  }
   /* call is only valid if we're actually currently sending
    * a message */
   current_envelope = mq->current_envelope;
@@ -329,7 +506,7 @@ impl_send_continue (void *cls,
   }
   if (NULL != current_envelope->sent_cb)
     current_envelope->sent_cb (current_envelope->sent_cls);
-  GNUNET_free (current_envelope);
+  envelope_free (current_envelope);
 }
 
 
@@ -385,6 +562,43 @@ GNUNET_MQ_queue_for_callbacks (GNUNET_MQ_SendImpl send,
 }
 
 
+/**
+ * Create a message queue that hands all messages that are ready to
+ * the implementation at once.
+ *
+ * @param send_batch function the implements sending messages
+ * @param destroy function that implements destroying the queue
+ * @param cancel function that implements canceling a batch
+ * @param impl_state for the queue, passed to 'send_batch' and 'destroy'
+ * @param handlers array of message handlers
+ * @param error_handler handler for read and write errors
+ * @param cls closure for message handlers and error handler
+ * @return a new message queue
+ */
+struct GNUNET_MQ_Handle *
+GNUNET_MQ_queue_for_callbacks_batched (GNUNET_MQ_SendBatchImpl send_batch,
+                                       GNUNET_MQ_DestroyImpl destroy,
+                                       GNUNET_MQ_CancelImpl cancel,
+                                       void *impl_state,
+                                       const struct GNUNET_MQ_MessageHandler *handlers,
+                                       GNUNET_MQ_ErrorHandler error_handler,
+                                       void *cls)
+{
+  struct GNUNET_MQ_Handle *mq;
+
+  mq = GNUNET_new (struct GNUNET_MQ_Handle);
+  mq->send_batch_impl = send_batch;
+  mq->destroy_impl = destroy;
+  mq->cancel_impl = cancel;
+  mq->handlers = handlers;
+  mq->error_handler = error_handler;
+  mq->handlers_cls = cls;
+  mq->impl_state = impl_state;
+
+  return mq;
+}
+
+
 /**
  * Get the message that should currently be sent.
  * Fails if there is no current message.
@@ -433,7 +647,16 @@ GNUNET_MQ_msg_ (struct GNUNET_MessageHeader **mhp,
 {
   struct GNUNET_MQ_Envelope *mqm;
 
-  mqm = GNUNET_malloc (sizeof *mqm + size);
+  if (size <= ENVELOPE_POOL_MESSAGE_SIZE)
+  {
+    mqm = GNUNET_pool_malloc (envelope_pool,
+                              sizeof *mqm + ENVELOPE_POOL_MESSAGE_SIZE);
+    mqm->pooled = GNUNET_YES;
+  }
+  else
+  {
+    mqm = GNUNET_malloc (sizeof *mqm + size);
+  }
   mqm->mh = (struct GNUNET_MessageHeader *) &mqm[1];
   mqm->mh->size = htons (size);
   mqm->mh->type = htons (type);
@@ -477,6 +700,58 @@ GNUNET_MQ_msg_nested_mh_ (struct GNUNET_MessageHeader **mhp,
 }
 
 
+/**
+ * Copy the messages of a batch into a transmission buffer.
+ *
+ * @param buf where to copy the messages
+ * @param size number of bytes available in @a buf
+ * @param msgs messages to copy
+ * @param count number of messages in @a msgs
+ * @return number of bytes written to @a buf
+ */
+static size_t
+copy_batch (char *buf,
+            size_t size,
+            const struct GNUNET_MessageHeader *const *msgs,
+            unsigned int count)
+{
+  unsigned int i;
+  size_t off;
+  size_t msg_size;
+
+  off = 0;
+  for (i = 0; i < count; i++)
+  {
+    msg_size = ntohs (msgs[i]->size);
+    GNUNET_assert (size - off >= msg_size);
+    memcpy (&buf[off], msgs[i], msg_size);
+    off += msg_size;
+  }
+  return off;
+}
+
+
+/**
+ * Compute the total size of the messages of a batch.
+ *
+ * @param msgs messages of the batch
+ * @param count number of messages in @a msgs
+ * @return total number of bytes
+ */
+static size_t
+batch_size (const struct GNUNET_MessageHeader *const *msgs,
+            unsigned int count)
+{
+  unsigned int i;
+  size_t total;
+
+  total = 0;
+  for (i = 0; i < count; i++)
+    total += ntohs (msgs[i]->size);
+  return total;
+}
+
+
 /**
  * Transmit a queued message to the session's client.
  *
@@ -491,14 +766,11 @@ transmit_queued (void *cls, size_t size,
 {
   struct GNUNET_MQ_Handle *mq = cls;
   struct ServerClientSocketState *state = GNUNET_MQ_impl_state (mq);
-  const struct GNUNET_MessageHeader *msg = GNUNET_MQ_impl_current (mq);
   size_t msg_size;
 
   GNUNET_assert (NULL != buf);
 
-  msg_size = ntohs (msg->size);
-  GNUNET_assert (size >= msg_size);
-  memcpy (buf, msg, msg_size);
+  msg_size = copy_batch (buf, size, state->msgs, state->msgs_count);
   state->th = NULL;
 
   GNUNET_MQ_impl_send_continue (mq);
@@ -507,6 +779,30 @@ transmit_queued (void *cls, size_t size,
 }
 
 
+/**
+ * The current batch of the queue was handed to the client's
+ * connection without copying it (or the transmission failed).
+ *
+ * @param cls the message queue
+ * @param result #GNUNET_OK if the message was transmitted
+ */
+static void
+transmitted_current (void *cls,
+                     int result)
+{
+  struct GNUNET_MQ_Handle *mq = cls;
+  struct ServerClientSocketState *state = GNUNET_MQ_impl_state (mq);
+
+  state->th = NULL;
+  if (GNUNET_OK != result)
+  {
+    GNUNET_MQ_inject_error (mq, GNUNET_MQ_ERROR_WRITE);
+    return;
+  }
+  GNUNET_MQ_impl_send_continue (mq);
+}
+
+
 static void
 server_client_destroy_impl (struct GNUNET_MQ_Handle *mq,
                             void *impl_state)
@@ -528,15 +824,28 @@ server_client_destroy_impl (struct GNUNET_MQ_Handle *mq,
 
 static void
 server_client_send_impl (struct GNUNET_MQ_Handle *mq,
-                         const struct GNUNET_MessageHeader *msg,
+                         const struct GNUNET_MessageHeader *const *msgs,
+                         unsigned int count,
                          void *impl_state)
 {
   struct ServerClientSocketState *state = impl_state;
 
   GNUNET_assert (NULL != mq);
   GNUNET_assert (NULL != state);
+  GNUNET_assert (count <= MAX_BATCH_MESSAGES);
+  memcpy (state->msgs, msgs, count * sizeof (msgs[0]));
+  state->msgs_count = count;
+  /* the envelopes stay alive until we call
+     #GNUNET_MQ_impl_send_continue(), so there is no need to copy them */
   state->th =
-      GNUNET_SERVER_notify_transmit_ready (state->client, ntohs (msg->size),
+      GNUNET_SERVER_transmit_messages (state->client, state->msgs, count,
+                                       GNUNET_TIME_UNIT_FOREVER_REL,
+                                       &transmitted_current, mq);
+  if (NULL != state->th)
+    return;
+  state->th =
+      GNUNET_SERVER_notify_transmit_ready (state->client,
+                                           batch_size (msgs, count),
                                            GNUNET_TIME_UNIT_FOREVER_REL,
                                            &transmit_queued, mq);
 }
@@ -553,7 +862,7 @@ GNUNET_MQ_queue_for_server_client (struct GNUNET_SERVER_Client *client)
   mq->impl_state = scss;
   scss->client = client;
   GNUNET_SERVER_client_keep (client);
-  mq->send_impl = server_client_send_impl;
+  mq->send_batch_impl = server_client_send_impl;
   mq->destroy_impl = server_client_destroy_impl;
   return mq;
 }
@@ -602,12 +911,10 @@ connection_client_transmit_queued (void *cls,
                                    void *buf)
 {
   struct GNUNET_MQ_Handle *mq = cls;
-  const struct GNUNET_MessageHeader *msg;
   struct ClientConnectionState *state = mq->impl_state;
   size_t msg_size;
 
   GNUNET_assert (NULL != mq);
-  msg = GNUNET_MQ_impl_current (mq);
 
   if (NULL == buf)
   {
@@ -623,9 +930,7 @@ connection_client_transmit_queued (void *cls,
                            GNUNET_TIME_UNIT_FOREVER_REL);
   }
 
-  msg_size = ntohs (msg->size);
-  GNUNET_assert (size >= msg_size);
-  memcpy (buf, msg, msg_size);
+  msg_size = copy_batch (buf, size, state->msgs, state->msgs_count);
   state->th = NULL;
 
   GNUNET_MQ_impl_send_continue (mq);
@@ -634,6 +939,30 @@ connection_client_transmit_queued (void *cls,
 }
 
 
+/**
+ * The current batch of the queue was handed to the connection
+ * to the service without copying it (or the transmission failed).
+ *
+ * @param cls the message queue
+ * @param result #GNUNET_OK if the message was transmitted
+ */
+static void
+connection_client_transmitted_current (void *cls,
+                                       int result)
+{
+  struct GNUNET_MQ_Handle *mq = cls;
+  struct ClientConnectionState *state = mq->impl_state;
+
+  state->th = NULL;
+  if (GNUNET_OK != result)
+  {
+    GNUNET_MQ_inject_error (mq, GNUNET_MQ_ERROR_WRITE);
+    return;
+  }
+  GNUNET_MQ_impl_send_continue (mq);
+}
+
+
 static void
 connection_client_destroy_impl (struct GNUNET_MQ_Handle *mq,
                                 void *impl_state)
@@ -644,15 +973,38 @@ connection_client_destroy_impl (struct GNUNET_MQ_Handle *mq,
 
 static void
 connection_client_send_impl (struct GNUNET_MQ_Handle *mq,
-                             const struct GNUNET_MessageHeader *msg,
+                             const struct GNUNET_MessageHeader *const *msgs,
+                             unsigned int count,
                              void *impl_state)
 {
   struct ClientConnectionState *state = impl_state;
 
   GNUNET_assert (NULL != state);
   GNUNET_assert (NULL == state->th);
+  GNUNET_assert (count <= MAX_BATCH_MESSAGES);
+  memcpy (state->msgs, msgs, count * sizeof (msgs[0]));
+  state->msgs_count = count;
+  /* the envelopes stay alive until we call
+     #GNUNET_MQ_impl_send_continue(), so there is no need to copy them */
   state->th =
-      GNUNET_CLIENT_notify_transmit_ready (state->connection, ntohs (msg->size),
+      GNUNET_CLIENT_transmit_messages (state->connection, state->msgs, count,
+                                       GNUNET_TIME_UNIT_FOREVER_REL,
+                                       &connection_client_transmitted_current,
+                                       mq);
+  if (NULL != state->th)
+  {
+    if ( (GNUNET_YES == state->receive_requested) &&
+         (GNUNET_NO == state->receive_active) )
+    {
+      state->receive_active = GNUNET_YES;
+      GNUNET_CLIENT_receive (state->connection, handle_client_message, mq,
+                             GNUNET_TIME_UNIT_FOREVER_REL);
+    }
+    return;
+  }
+  state->th =
+      GNUNET_CLIENT_notify_transmit_ready (state->connection,
+                                           batch_size (msgs, count),
                                            GNUNET_TIME_UNIT_FOREVER_REL, GNUNET_NO,
                                            &connection_client_transmit_queued, mq);
   GNUNET_assert (NULL != state->th);
@@ -688,7 +1040,7 @@ GNUNET_MQ_queue_for_connection_client (struct GNUNET_CLIENT_Connection *connecti
   state = GNUNET_new (struct ClientConnectionState);
   state->connection = connection;
   mq->impl_state = state;
-  mq->send_impl = connection_client_send_impl;
+  mq->send_batch_impl = connection_client_send_impl;
   mq->destroy_impl = connection_client_destroy_impl;
   mq->cancel_impl = connection_client_cancel_impl;
   if (NULL != handlers)
@@ -780,6 +1132,19 @@ GNUNET_MQ_destroy (struct GNUNET_MQ_Handle *mq)
     GNUNET_SCHEDULER_cancel (mq->continue_task);
     mq->continue_task = NULL;
   }
+  if (NULL != mq->flush_task)
+  {
+    GNUNET_SCHEDULER_cancel (mq->flush_task);
+    mq->flush_task = NULL;
+  }
+  while (NULL != mq->batch_head)
+  {
+    struct GNUNET_MQ_Envelope *ev;
+    ev = mq->batch_head;
+    ev->parent_queue = NULL;
+    GNUNET_CONTAINER_DLL_remove (mq->batch_head, mq->batch_tail, ev);
+    GNUNET_MQ_discard (ev);
+  }
   while (NULL != mq->envelope_head)
   {
     struct GNUNET_MQ_Envelope *ev;
@@ -851,6 +1216,38 @@ GNUNET_MQ_send_cancel (struct GNUNET_MQ_Envelope *ev)
   GNUNET_assert (NULL != mq);
   GNUNET_assert (NULL != mq->cancel_impl);
 
+  if (NULL != mq->send_batch_impl)
+  {
+    struct GNUNET_MQ_Envelope *pos;
+
+    for (pos = mq->batch_head; NULL != pos; pos = pos->next)
+      if (pos == ev)
+        break;
+    if (NULL == pos)
+    {
+      GNUNET_CONTAINER_DLL_remove (mq->envelope_head, mq->envelope_tail, ev);
+    }
+    else
+    {
+      /* abort the whole batch, put the other messages back in
+         front of the queue and start over without @a ev */
+      mq->cancel_impl (mq, mq->impl_state);
+      GNUNET_CONTAINER_DLL_remove (mq->batch_head, mq->batch_tail, ev);
+      while (NULL != (pos = mq->batch_tail))
+      {
+        GNUNET_CONTAINER_DLL_remove (mq->batch_head, mq->batch_tail, pos);
+        GNUNET_CONTAINER_DLL_insert (mq->envelope_head,
+                                     mq->envelope_tail,
+                                     pos);
+      }
+      send_batch (mq);
+    }
+    ev->parent_queue = NULL;
+    ev->mh = NULL;
+    envelope_free (ev);
+    return;
+  }
+
   if (mq->current_envelope == ev) {
     // complex case, we already started with transmitting
     // the message
@@ -875,7 +1272,7 @@ GNUNET_MQ_send_cancel (struct GNUNET_MQ_Envelope *ev)
 
   ev->parent_queue = NULL;
   ev->mh = NULL;
-  GNUNET_free (ev);
+  envelope_free (ev);
 }
 
 /* end of mq.c */
@@ -39,6 +39,19 @@
 #define INVALID_SOCKET -1
 #endif
 
+/**
+ * Maximum number of datagrams passed to the kernel in one
+ * recvmmsg() or sendmmsg() call.
+ */
+#define MAX_MMSG_BATCH 64
+
+#if HAVE_SENDMMSG && HAVE_RECVMMSG && defined(UDP_SEGMENT) && defined(UDP_GRO)
+/**
+ * Do we support UDP segmentation offload (Linux GSO/GRO)?
+ */
+#define UDP_OFFLOAD 1
+#endif
+
 
 /**
  * @brief handle to a socket
@@ -907,6 +920,68 @@ GNUNET_NETWORK_socket_send (const struct GNUNET_NETWORK_Handle *desc,
 }
 
 
+/**
+ * Send data from several buffers with a single call (always
+ * non-blocking).
+ *
+ * @param desc socket
+ * @param buffers data to send
+ * @param lengths number of bytes in each of the @a buffers
+ * @param count number of entries in @a buffers and @a lengths
+ * @return number of bytes sent, #GNUNET_SYSERR on error
+ */
+ssize_t
+GNUNET_NETWORK_socket_sendv (const struct GNUNET_NETWORK_Handle *desc,
+                             const void *const *buffers,
+                             const size_t *lengths,
+                             unsigned int count)
+{
+#ifndef MINGW
+  struct iovec iov[count];
+  struct msghdr msg;
+  unsigned int i;
+  int flags;
+
+  flags = 0;
+#ifdef MSG_DONTWAIT
+  flags |= MSG_DONTWAIT;
+#endif
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+  for (i = 0; i < count; i++)
+  {
+    iov[i].iov_base = (void *) buffers[i];
+    iov[i].iov_len = lengths[i];
+  }
+  memset (&msg, 0, sizeof (msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = count;
+  return sendmsg (desc->fd,
+                  &msg,
+                  flags);
+#else
+  ssize_t total;
+  ssize_t ret;
+  unsigned int i;
+
+  total = 0;
+  for (i = 0; i < count; i++)
+  {
+    ret = GNUNET_NETWORK_socket_send (desc,
+                                      buffers[i],
+                                      lengths[i]);
+    if (-1 == ret)
+      return (0 == total) ? GNUNET_SYSERR : total;
+    total += ret;
+    if (ret < lengths[i])
+      break;
+  }
+  return total;
+#endif
+}
+
+
 /**
  * Send data to a particular destination (always non-blocking).
  * This function only works for UDP sockets.
@@ -945,6 +1020,233 @@ GNUNET_NETWORK_socket_sendto (const struct GNUNET_NETWORK_Handle *desc,
 }
 
 
+/**
+ * Read multiple datagrams from a socket (always non-blocking), using
+ * a single system call where the platform supports it.
+ *
+ * @param desc socket
+ * @param dgrams array of datagrams to fill in
+ * @param count number of entries in @a dgrams
+ * @return number of datagrams received (at least one), or
+ *         #GNUNET_SYSERR on error
+ */
+int
+GNUNET_NETWORK_socket_recvfrom_batch (const struct GNUNET_NETWORK_Handle *desc,
+                                      struct GNUNET_NETWORK_Datagram *dgrams,
+                                      unsigned int count)
+{
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[MAX_MMSG_BATCH];
+  struct iovec iov[MAX_MMSG_BATCH];
+#if UDP_OFFLOAD
+  char control[MAX_MMSG_BATCH][CMSG_SPACE (sizeof (int))];
+  struct cmsghdr *cmsg;
+  int gso_size;
+#endif
+  unsigned int i;
+  int ret;
+
+  if (count > MAX_MMSG_BATCH)
+    count = MAX_MMSG_BATCH;
+  memset (msgs, 0, sizeof (struct mmsghdr) * count);
+  for (i = 0; i < count; i++)
+  {
+    iov[i].iov_base = dgrams[i].buffer;
+    iov[i].iov_len = dgrams[i].length;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = dgrams[i].addr;
+    msgs[i].msg_hdr.msg_namelen = dgrams[i].addrlen;
+#if UDP_OFFLOAD
+    msgs[i].msg_hdr.msg_control = control[i];
+    msgs[i].msg_hdr.msg_controllen = sizeof (control[i]);
+#endif
+  }
+  ret = recvmmsg (desc->fd,
+                  msgs,
+                  count,
+                  MSG_DONTWAIT,
+                  NULL);
+  if (ret <= 0)
+  {
+    if (0 == ret)
+      errno = EAGAIN;
+    return GNUNET_SYSERR;
+  }
+  for (i = 0; i < (unsigned int) ret; i++)
+  {
+    dgrams[i].length = msgs[i].msg_len;
+    dgrams[i].addrlen = msgs[i].msg_hdr.msg_namelen;
+    dgrams[i].segment_size = 0;
+#if UDP_OFFLOAD
+    for (cmsg = CMSG_FIRSTHDR (&msgs[i].msg_hdr);
+         NULL != cmsg;
+         cmsg = CMSG_NXTHDR (&msgs[i].msg_hdr, cmsg))
+    {
+      if ( (SOL_UDP != cmsg->cmsg_level) ||
+           (UDP_GRO != cmsg->cmsg_type) )
+        continue;
+      memcpy (&gso_size,
+              CMSG_DATA (cmsg),
+              sizeof (gso_size));
+      if ( (gso_size > 0) &&
+           ((size_t) gso_size < dgrams[i].length) )
+        dgrams[i].segment_size = (uint16_t) gso_size;
+    }
+#endif
+  }
+  return ret;
+#else
+  unsigned int i;
+  ssize_t size;
+
+  for (i = 0; i < count; i++)
+  {
+    size = GNUNET_NETWORK_socket_recvfrom (desc,
+                                           dgrams[i].buffer,
+                                           dgrams[i].length,
+                                           dgrams[i].addr,
+                                           &dgrams[i].addrlen);
+    if (-1 == size)
+      break;
+    dgrams[i].length = size;
+    dgrams[i].segment_size = 0;
+  }
+  if (0 == i)
+    return GNUNET_SYSERR;
+  return i;
+#endif
+}
+
+
+/**
+ * Send multiple datagrams (always non-blocking), using a single
+ * system call where the platform supports it.
+ *
+ * @param desc socket
+ * @param dgrams array of datagrams to send
+ * @param count number of entries in @a dgrams
+ * @return number of datagrams sent from the beginning of @a dgrams
+ *         (at least one), or #GNUNET_SYSERR if the first datagram
+ *         could not be sent
+ */
+int
+GNUNET_NETWORK_socket_sendto_batch (const struct GNUNET_NETWORK_Handle *desc,
+                                    const struct GNUNET_NETWORK_Datagram *dgrams,
+                                    unsigned int count)
+{
+#if HAVE_SENDMMSG
+  struct mmsghdr msgs[MAX_MMSG_BATCH];
+  struct iovec iov[MAX_MMSG_BATCH];
+#if UDP_OFFLOAD
+  char control[MAX_MMSG_BATCH][CMSG_SPACE (sizeof (uint16_t))];
+  struct cmsghdr *cmsg;
+#endif
+  unsigned int i;
+  int flags;
+  int ret;
+
+  flags = MSG_DONTWAIT;
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL;
+#endif
+  if (count > MAX_MMSG_BATCH)
+    count = MAX_MMSG_BATCH;
+  memset (msgs, 0, sizeof (struct mmsghdr) * count);
+  for (i = 0; i < count; i++)
+  {
+    iov[i].iov_base = dgrams[i].buffer;
+    iov[i].iov_len = dgrams[i].length;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = dgrams[i].addr;
+    msgs[i].msg_hdr.msg_namelen = dgrams[i].addrlen;
+#if UDP_OFFLOAD
+    if (0 != dgrams[i].segment_size)
+    {
+      memset (control[i],
+              0,
+              sizeof (control[i]));
+      msgs[i].msg_hdr.msg_control = control[i];
+      msgs[i].msg_hdr.msg_controllen = sizeof (control[i]);
+      cmsg = CMSG_FIRSTHDR (&msgs[i].msg_hdr);
+      cmsg->cmsg_level = SOL_UDP;
+      cmsg->cmsg_type = UDP_SEGMENT;
+      cmsg->cmsg_len = CMSG_LEN (sizeof (uint16_t));
+      memcpy (CMSG_DATA (cmsg),
+              &dgrams[i].segment_size,
+              sizeof (uint16_t));
+    }
+#endif
+  }
+  ret = sendmmsg (desc->fd,
+                  msgs,
+                  count,
+                  flags);
+  if (ret <= 0)
+  {
+    if (0 == ret)
+      errno = EAGAIN;
+    return GNUNET_SYSERR;
+  }
+  return ret;
+#else
+  unsigned int i;
+
+  for (i = 0; i < count; i++)
+    if (-1 == GNUNET_NETWORK_socket_sendto (desc,
+                                            dgrams[i].buffer,
+                                            dgrams[i].length,
+                                            dgrams[i].addr,
+                                            dgrams[i].addrlen))
+      break;
+  if (0 == i)
+    return GNUNET_SYSERR;
+  return i;
+#endif
+}
+
+
+/**
+ * Enable UDP segmentation offload on a UDP socket, if the platform
+ * supports it.  Afterwards #GNUNET_NETWORK_socket_recvfrom_batch()
+ * may return coalesced datagrams, and
+ * #GNUNET_NETWORK_socket_sendto_batch() may be given datagrams with
+ * a non-zero segment size.
+ *
+ * @param desc socket
+ * @return #GNUNET_YES if sending with a segment size is supported,
+ *         #GNUNET_NO if not
+ */
+int
+GNUNET_NETWORK_socket_udp_offload (struct GNUNET_NETWORK_Handle *desc)
+{
+#if UDP_OFFLOAD
+  int on = 1;
+  int off = 0;
+
+  /* receiving coalesced datagrams is fine even if we cannot send them */
+  (void) setsockopt (desc->fd,
+                     SOL_UDP,
+                     UDP_GRO,
+                     &on,
+                     sizeof (on));
+  /* a zero socket-wide segment size is a no-op that tells us whether
+     the kernel understands UDP_SEGMENT, without enabling it for
+     every datagram */
+  if (0 != setsockopt (desc->fd,
+                       SOL_UDP,
+                       UDP_SEGMENT,
+                       &off,
+                       sizeof (off)))
+    return GNUNET_NO;
+  return GNUNET_YES;
+#else
+  return GNUNET_NO;
+#endif
+}
+
+
 /**
  * Set socket option
  *
@@ -1091,6 +1393,42 @@ GNUNET_NETWORK_socket_disable_corking (struct GNUNET_NETWORK_Handle *desc)
 }
 
 
+/**
+ * Limit the amount of data that the kernel accepts for transmission
+ * on the given TCP socket beyond what it could already send.  With
+ * a small limit, data stays queued in the application (where it can
+ * still be reordered) instead of waiting in the kernel's send buffer.
+ *
+ * @param desc socket
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the option is
+ *         not supported by the platform or the socket
+ */
+int
+GNUNET_NETWORK_socket_set_notsent_lowat (struct GNUNET_NETWORK_Handle *desc,
+                                         uint32_t bytes)
+{
+#ifdef TCP_NOTSENT_LOWAT
+  unsigned int value = bytes;
+
+  if (0 != setsockopt (desc->fd,
+                       IPPROTO_TCP,
+                       TCP_NOTSENT_LOWAT,
+                       &value,
+                       sizeof (value)))
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_DEBUG,
+                  "setsockopt");
+    return GNUNET_SYSERR;
+  }
+  return GNUNET_OK;
+#else
+  errno = ENOSYS;
+  return GNUNET_SYSERR;
+#endif
+}
+
+
 /**
  * Reset FD set
  *
@@ -46,6 +46,11 @@ struct PeerEntry
    * Reference counter, 0 if this slot is not used.
    */
   unsigned int rc;
+
+  /**
+   * Cached short string form of @e id, as returned by #GNUNET_i2s().
+   */
+  char short_id[6];
 };
 
 
@@ -141,6 +146,11 @@ GNUNET_PEER_intern (const struct GNUNET_PeerIdentity *pid)
   GNUNET_assert (0 == table[ret]->rc);
   free_list_start = table[ret]->pid;
   table[ret]->id = *pid;
+  GNUNET_assert (NULL !=
+                 GNUNET_STRINGS_data_to_string (&pid->public_key, 3,
+                                                table[ret]->short_id,
+                                                sizeof (table[ret]->short_id) - 1));
+  table[ret]->short_id[4] = '\0';
   table[ret]->rc = 1;
   table[ret]->pid = ret;
   GNUNET_break (GNUNET_OK ==
@@ -247,5 +257,25 @@ GNUNET_PEER_resolve2 (GNUNET_PEER_Id id)
 }
 
 
+/**
+ * Convert an interned PID to a short string (for printing debug
+ * messages).  Unlike #GNUNET_i2s(), the string is computed only once
+ * per interned identity and the result is reentrant.
+ *
+ * @param id interned PID to convert
+ * @return short string form of the peer identity, valid as long
+ *         @a id is valid
+ */
+const char *
+GNUNET_PEER_i2s (GNUNET_PEER_Id id)
+{
+  if (0 == id)
+    return "NULL";
+  GNUNET_assert (id < size);
+  GNUNET_assert (table[id]->rc > 0);
+  return table[id]->short_id;
+}
+
+
 
 /* end of peer.c */
@@ -0,0 +1,154 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @author Christian Grothoff
+ * @file util/perf_container.c
+ * @brief measure performance of the multihashmap, bloomfilter and heap
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_benchmark_lib.h"
+
+/**
+ * Number of elements each benchmark works with.
+ */
+#define ELEMENTS (64 * 1024)
+
+/**
+ * Size of the bloomfilter, about one byte per element.
+ */
+#define BF_SIZE (64 * 1024)
+
+/**
+ * Number of hash functions of the bloomfilter.
+ */
+#define BF_K 16
+
+/**
+ * Keys used by all benchmarks.
+ */
+static struct GNUNET_HashCode *keys;
+
+/**
+ * Costs of the heap elements.
+ */
+static GNUNET_CONTAINER_HeapCostType *costs;
+
+
+static uint64_t
+perfMultiHashMap (void *cls)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *map;
+  unsigned int i;
+
+  map = GNUNET_CONTAINER_multihashmap_create (ELEMENTS,
+                                              GNUNET_YES);
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_CONTAINER_multihashmap_put (map,
+                                                     &keys[i],
+                                                     &keys[i],
+                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_FAST));
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_break (&keys[i] ==
+                  GNUNET_CONTAINER_multihashmap_get (map,
+                                                     &keys[i]));
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_break (GNUNET_YES ==
+                  GNUNET_CONTAINER_multihashmap_remove (map,
+                                                        &keys[i],
+                                                        &keys[i]));
+  GNUNET_CONTAINER_multihashmap_destroy (map);
+  return 3 * ELEMENTS;
+}
+
+
+static uint64_t
+perfBloomfilter (void *cls)
+{
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  unsigned int i;
+
+  bf = GNUNET_CONTAINER_bloomfilter_init (NULL,
+                                          BF_SIZE,
+                                          BF_K);
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_CONTAINER_bloomfilter_add (bf,
+                                      &keys[i]);
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_break (GNUNET_YES ==
+                  GNUNET_CONTAINER_bloomfilter_test (bf,
+                                                     &keys[i]));
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+  return 2 * ELEMENTS;
+}
+
+
+static uint64_t
+perfHeap (void *cls)
+{
+  struct GNUNET_CONTAINER_Heap *heap;
+  unsigned int i;
+
+  heap = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_CONTAINER_heap_insert (heap,
+                                  &keys[i],
+                                  costs[i]);
+  for (i=0;i<ELEMENTS;i++)
+    GNUNET_break (NULL !=
+                  GNUNET_CONTAINER_heap_remove_root (heap));
+  GNUNET_CONTAINER_heap_destroy (heap);
+  return 2 * ELEMENTS;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_BENCHMARK_Suite *suite;
+  unsigned int i;
+
+  keys = GNUNET_new_array (ELEMENTS,
+                           struct GNUNET_HashCode);
+  costs = GNUNET_new_array (ELEMENTS,
+                            GNUNET_CONTAINER_HeapCostType);
+  for (i=0;i<ELEMENTS;i++)
+  {
+    GNUNET_CRYPTO_hash (&i,
+                        sizeof (i),
+                        &keys[i]);
+    costs[i] = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                         UINT64_MAX);
+  }
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_container");
+  GNUNET_BENCHMARK_run (suite, "Multihashmap put/get/remove", "ops", 10,
+                        &perfMultiHashMap, NULL);
+  GNUNET_BENCHMARK_run (suite, "Bloomfilter add/test", "ops", 10,
+                        &perfBloomfilter, NULL);
+  GNUNET_BENCHMARK_run (suite, "Heap insert/remove", "ops", 10,
+                        &perfHeap, NULL);
+  GNUNET_free (keys);
+  GNUNET_free (costs);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
+}
+
+/* end of perf_container.c */
@@ -25,10 +25,12 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 
 static struct GNUNET_TIME_Absolute start;
 
+static struct GNUNET_BENCHMARK_Suite *suite;
+
 #define l 50
 
 struct TestSig
@@ -43,18 +45,14 @@ static void
 log_duration (const char *cryptosystem,
               const char *description)
 {
-  struct GNUNET_TIME_Relative t;
   char s[64];
 
   sprintf (s, "%6s %15s", cryptosystem, description);
-  t = GNUNET_TIME_absolute_get_duration (start);
-  t = GNUNET_TIME_relative_divide (t, l);
-  FPRINTF (stdout,
-           "%s: %10s\n",
-           s,
-           GNUNET_STRINGS_relative_time_to_string (t,
-                                                   GNUNET_NO));
-  GAUGER ("UTIL", s, t.rel_value_us, "us");
+  GNUNET_BENCHMARK_report (suite,
+                           s,
+                           "ops",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           l);
 }
 
 
@@ -67,7 +65,11 @@ main (int argc, char *argv[])
   struct GNUNET_CRYPTO_EddsaPrivateKey *eddsa[l];
   struct GNUNET_CRYPTO_EddsaPublicKey dspub[l];
   struct TestSig sig[l];
+  const struct GNUNET_CRYPTO_EccSignaturePurpose *purps[l];
+  struct GNUNET_CRYPTO_EddsaSignature sigs[l];
+  struct GNUNET_CRYPTO_EddsaPublicKey pubs[l];
 
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_crypto_asymmetric");
   start = GNUNET_TIME_absolute_get();
   for (i = 0; i < l; i++)
   {
@@ -107,6 +109,40 @@ main (int argc, char *argv[])
                                                &dspub[i]));
   log_duration ("EdDSA", "verify HashCode");
 
+  /* same key for all messages, as for a peer's own signatures */
+  start = GNUNET_TIME_absolute_get();
+  for (i = 0; i < l; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CRYPTO_eddsa_sign (eddsa[0],
+                                             &sig[i].purp,
+                                             &sig[i].sig));
+  log_duration ("EdDSA", "sign same key");
+
+  start = GNUNET_TIME_absolute_get();
+  for (i = 0; i < l; i++)
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CRYPTO_eddsa_verify (0,
+                                               &sig[i].purp,
+                                               &sig[i].sig,
+                                               &dspub[0]));
+  log_duration ("EdDSA", "verify same key");
+
+  for (i = 0; i < l; i++)
+  {
+    purps[i] = &sig[i].purp;
+    sigs[i] = sig[i].sig;
+    pubs[i] = dspub[0];
+  }
+  start = GNUNET_TIME_absolute_get();
+  GNUNET_assert (l ==
+                 GNUNET_CRYPTO_eddsa_verify_batch (0,
+                                                   l,
+                                                   purps,
+                                                   sigs,
+                                                   pubs,
+                                                   NULL));
+  log_duration ("EdDSA", "verify batch");
+
   start = GNUNET_TIME_absolute_get();
   for (i = 0; i < l; i++)
     ecdhe[i] = GNUNET_CRYPTO_ecdhe_key_create();
@@ -125,7 +161,7 @@ main (int argc, char *argv[])
   }
   log_duration ("ECDH", "do DH");
 
-  return 0;
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_crypto_asymmetric.c */
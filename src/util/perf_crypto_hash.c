@@ -25,12 +25,12 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 #include <gcrypt.h>
 
 
-static void
-perfHash ()
+static uint64_t
+perfHash (void *cls)
 {
   struct GNUNET_HashCode hc;
   unsigned int i;
@@ -39,11 +39,12 @@ perfHash ()
   memset (buf, 1, sizeof (buf));
   for (i = 0; i < 1024; i++)
     GNUNET_CRYPTO_hash (buf, sizeof (buf), &hc);
+  return 64 * 1024;
 }
 
 
-static void
-perfHKDF ()
+static uint64_t
+perfHKDF (void *cls)
 {
   unsigned int i;
   char res[128];
@@ -59,33 +60,21 @@ perfHKDF ()
                         skm, sizeof (skm),
                         "test", (size_t) 4,
                         NULL, 0);
+  return 1024;
 }
 
 
 int
 main (int argc, char *argv[])
 {
-  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_BENCHMARK_Suite *suite;
 
-  start = GNUNET_TIME_absolute_get ();
-  perfHash ();
-  printf ("Hash perf took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Cryptographic hashing",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "kb/ms");
-  start = GNUNET_TIME_absolute_get ();
-  perfHKDF ();
-  printf ("HKDF perf took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Cryptographic HKDF",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "kb/ms");
-  return 0;
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_crypto_hash");
+  GNUNET_BENCHMARK_run (suite, "Cryptographic hashing", "kb", 10,
+                        &perfHash, NULL);
+  GNUNET_BENCHMARK_run (suite, "Cryptographic HKDF", "ops", 10,
+                        &perfHKDF, NULL);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_crypto_hash.c */
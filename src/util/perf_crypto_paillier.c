@@ -25,30 +25,111 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
+
+/**
+ * Number of operations per measurement.
+ */
+#define ROUNDS 10
+
+
+/**
+ * Key used for all measurements.
+ */
+static struct GNUNET_CRYPTO_PaillierPublicKey public_key;
+
+/**
+ * Pool of precomputed values for #public_key.
+ */
+static struct GNUNET_CRYPTO_PaillierRandomPool *pool;
+
+/**
+ * Plaintexts to encrypt.
+ */
+static gcry_mpi_t plaintexts[ROUNDS];
+
+/**
+ * Benchmark suite we report to.
+ */
+static struct GNUNET_BENCHMARK_Suite *suite;
+
+
+/**
+ * Report the result of a measurement of #ROUNDS operations.
+ *
+ * @param what name of the operation
+ * @param unit unit of the operations
+ * @param start when the measurement started
+ */
+static void
+report (const char *what,
+        const char *unit,
+        struct GNUNET_TIME_Absolute start)
+{
+  GNUNET_BENCHMARK_report (suite,
+                           what,
+                           unit,
+                           GNUNET_TIME_absolute_get_duration (start),
+                           ROUNDS);
+}
+
+
+/**
+ * Wait until the pool is full, then measure encryptions using it.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+measure_pool (void *cls,
+              const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CRYPTO_PaillierCiphertext c[ROUNDS];
+  struct GNUNET_TIME_Absolute start;
+
+  if (NULL == pool)
+    pool = GNUNET_CRYPTO_paillier_pool_create (&public_key,
+                                               ROUNDS);
+  if (ROUNDS > GNUNET_CRYPTO_paillier_pool_get_available (pool))
+  {
+    GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_MILLISECONDS,
+                                  &measure_pool,
+                                  NULL);
+    return;
+  }
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_CRYPTO_paillier_encrypt_batch (&public_key,
+                                        pool,
+                                        plaintexts,
+                                        ROUNDS,
+                                        2,
+                                        c);
+  report ("Paillier pooled encryption",
+          "ops",
+          start);
+  GNUNET_CRYPTO_paillier_pool_destroy (pool);
+  pool = NULL;
+}
 
 
 int
 main (int argc, char *argv[])
 {
   struct GNUNET_TIME_Absolute start;
-  struct GNUNET_CRYPTO_PaillierPublicKey public_key;
   struct GNUNET_CRYPTO_PaillierPrivateKey private_key;
   struct GNUNET_CRYPTO_PaillierCiphertext c1;
+  struct GNUNET_CRYPTO_PaillierCiphertext c[ROUNDS];
   gcry_mpi_t m1;
   unsigned int i;
 
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_crypto_paillier");
   start = GNUNET_TIME_absolute_get ();
-  for (i=0;i<10;i++)
+  for (i=0;i<ROUNDS;i++)
     GNUNET_CRYPTO_paillier_create (&public_key,
                                    &private_key);
-  printf ("10x key generation took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Paillier key generation",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "keys/ms");
+  report ("Paillier key generation",
+          "keys",
+          start);
 
   m1 = gcry_mpi_new (0);
   m1 = gcry_mpi_set_ui (m1, 1);
@@ -57,35 +138,72 @@ main (int argc, char *argv[])
                      m1,
                      GNUNET_CRYPTO_PAILLIER_BITS - 3);
   start = GNUNET_TIME_absolute_get ();
-  for (i=0;i<10;i++)
+  for (i=0;i<ROUNDS;i++)
     GNUNET_CRYPTO_paillier_encrypt (&public_key,
                                     m1,
                                     2,
                                     &c1);
-  printf ("10x encryption took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Paillier encryption",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  report ("Paillier encryption",
+          "ops",
+          start);
 
   start = GNUNET_TIME_absolute_get ();
-  for (i=0;i<10;i++)
+  for (i=0;i<ROUNDS;i++)
     GNUNET_CRYPTO_paillier_decrypt (&private_key,
                                     &public_key,
                                     &c1,
                                     m1);
-  printf ("10x decryption took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Paillier decryption",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  report ("Paillier decryption",
+          "ops",
+          start);
 
+  for (i=0;i<ROUNDS;i++)
+  {
+    plaintexts[i] = gcry_mpi_new (0);
+    gcry_mpi_randomize (plaintexts[i],
+                        GNUNET_CRYPTO_PAILLIER_BITS - 3,
+                        GCRY_WEAK_RANDOM);
+  }
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_CRYPTO_paillier_encrypt_batch (&public_key,
+                                        NULL,
+                                        plaintexts,
+                                        ROUNDS,
+                                        2,
+                                        c);
+  report ("Paillier batch encryption",
+          "ops",
+          start);
+
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_CRYPTO_paillier_decrypt_batch (&private_key,
+                                        &public_key,
+                                        c,
+                                        ROUNDS,
+                                        plaintexts);
+  report ("Paillier batch decryption",
+          "ops",
+          start);
+
+  /* decryption without the CRT, for comparison */
+  memset (private_key.p, 0, sizeof (private_key.p));
+  memset (private_key.q, 0, sizeof (private_key.q));
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_CRYPTO_paillier_decrypt_batch (&private_key,
+                                        &public_key,
+                                        c,
+                                        ROUNDS,
+                                        plaintexts);
+  report ("Paillier batch decryption without CRT",
+          "ops",
+          start);
 
-  return 0;
+  GNUNET_SCHEDULER_run (&measure_pool,
+                        NULL);
+  for (i=0;i<ROUNDS;i++)
+    gcry_mpi_release (plaintexts[i]);
+  gcry_mpi_release (m1);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_crypto_paillier.c */
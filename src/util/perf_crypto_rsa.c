@@ -25,7 +25,12 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
+
+/**
+ * Benchmark suite we report to.
+ */
+static struct GNUNET_BENCHMARK_Suite *suite;
 
 
 /**
@@ -54,18 +59,13 @@ eval (unsigned int len)
     private_key = GNUNET_CRYPTO_rsa_private_key_create (len);
     GNUNET_CRYPTO_rsa_private_key_free (private_key);
   }
-  printf ("10x %u-key generation took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-                                                  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-key generation",
                    len);
-  GAUGER ("UTIL", sbuf,
-          64 * 1024 / (1 +
-                       GNUNET_TIME_absolute_get_duration
-                       (start).rel_value_us / 1000LL), "keys/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "keys",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   private_key = GNUNET_CRYPTO_rsa_private_key_create (len);
   public_key = GNUNET_CRYPTO_rsa_private_key_get_public (private_key);
   start = GNUNET_TIME_absolute_get ();
@@ -74,18 +74,13 @@ eval (unsigned int len)
     bkey = GNUNET_CRYPTO_rsa_blinding_key_create (len);
     GNUNET_CRYPTO_rsa_blinding_key_free (bkey);
   }
-  printf ("10x %u-blinding key generation took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-                                                  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-blinding key generation",
                    len);
-  GAUGER ("UTIL", sbuf,
-          64 * 1024 / (1 +
-                       GNUNET_TIME_absolute_get_duration
-                       (start).rel_value_us / 1000LL), "keys/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "keys",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   bkey = GNUNET_CRYPTO_rsa_blinding_key_create (len);
   start = GNUNET_TIME_absolute_get ();
   GNUNET_CRYPTO_hash ("test", 4, &hc);
@@ -97,19 +92,13 @@ eval (unsigned int len)
                                         &bbuf);
     GNUNET_free (bbuf);
   }
-  printf ("10x %u-blinding took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-blinding",
                    len);
-  GAUGER ("UTIL",
-          sbuf,
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "ops",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   bbuf_len = GNUNET_CRYPTO_rsa_blind (&hc,
                                       bkey,
                                       public_key,
@@ -122,19 +111,13 @@ eval (unsigned int len)
                                   bbuf_len);
     GNUNET_CRYPTO_rsa_signature_free (sig);
   }
-  printf ("10x %u-signing took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-signing",
                    len);
-  GAUGER ("UTIL",
-          sbuf,
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "ops",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   sig = GNUNET_CRYPTO_rsa_sign (private_key,
                                 bbuf,
                                 bbuf_len);
@@ -146,19 +129,13 @@ eval (unsigned int len)
                                       public_key);
     GNUNET_CRYPTO_rsa_signature_free (rsig);
   }
-  printf ("10x %u-unblinding took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-unblinding",
                    len);
-  GAUGER ("UTIL",
-          sbuf,
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "ops",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   rsig = GNUNET_CRYPTO_rsa_unblind (sig,
                                     bkey,
                                     public_key);
@@ -170,19 +147,13 @@ eval (unsigned int len)
                                              rsig,
                                              public_key));
   }
-  printf ("10x %u-verifying took %s\n",
-          len,
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
   GNUNET_snprintf (sbuf,
                    sizeof (sbuf),
                    "RSA %u-verification",
                    len);
-  GAUGER ("UTIL",
-          sbuf,
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "ops/ms");
+  GNUNET_BENCHMARK_report (suite, sbuf, "ops",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           10);
   GNUNET_CRYPTO_rsa_signature_free (sig);
   GNUNET_CRYPTO_rsa_public_key_free (public_key);
   GNUNET_CRYPTO_rsa_private_key_free (private_key);
@@ -194,10 +165,11 @@ eval (unsigned int len)
 int
 main (int argc, char *argv[])
 {
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_crypto_rsa");
   eval (1024);
   eval (2048);
   /* eval (4096); */
-  return 0;
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 
@@ -25,11 +25,11 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 
 
-static void
-perfEncrypt ()
+static uint64_t
+perfEncrypt (void *cls)
 {
   unsigned int i;
   char buf[64 * 1024];
@@ -52,24 +52,19 @@ perfEncrypt ()
   }
   memset (rbuf, 1, sizeof (rbuf));
   GNUNET_assert (0 == memcmp (rbuf, buf, sizeof (buf)));
+  return 64 * 1024;
 }
 
 
 int
 main (int argc, char *argv[])
 {
-  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_BENCHMARK_Suite *suite;
 
-  start = GNUNET_TIME_absolute_get ();
-  perfEncrypt ();
-  printf ("Encrypt perf took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Symmetric encryption",
-          64 * 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "kb/ms");
-  return 0;
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_crypto_symmetric");
+  GNUNET_BENCHMARK_run (suite, "Symmetric encryption", "kb", 10,
+                        &perfEncrypt, NULL);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_crypto_aes.c */
@@ -25,10 +25,10 @@
  */
 #include "platform.h"
 #include "gnunet_util_lib.h"
-#include <gauger.h>
+#include "gnunet_benchmark_lib.h"
 
 static uint64_t
-perfMalloc ()
+perfMalloc (void *cls)
 {
   size_t i;
   uint64_t ret;
@@ -39,26 +39,81 @@ perfMalloc ()
       ret += i;
       GNUNET_free (GNUNET_malloc (i));
     }
-  return ret;
+  return ret / 1024;
+}
+
+
+/**
+ * Number of times #perfPool() and #perfSmallMalloc() allocate
+ * and release objects.
+ */
+#define SMALL_ROUNDS (1024 * 1024)
+
+/**
+ * Number of objects that are alive at the same time in
+ * #perfPool() and #perfSmallMalloc().
+ */
+#define SMALL_LIVE 64
+
+/**
+ * Size of the objects allocated by #perfPool() and #perfSmallMalloc(),
+ * about the size of a scheduler task.
+ */
+#define SMALL_SIZE 144
+
+
+static uint64_t
+perfSmallMalloc (void *cls)
+{
+  void *live[SMALL_LIVE];
+  size_t i;
+
+  memset (live, 0, sizeof (live));
+  for (i=0;i<SMALL_ROUNDS;i++)
+    {
+      GNUNET_free_non_null (live[i % SMALL_LIVE]);
+      live[i % SMALL_LIVE] = GNUNET_malloc (SMALL_SIZE);
+    }
+  for (i=0;i<SMALL_LIVE;i++)
+    GNUNET_free (live[i]);
+  return SMALL_ROUNDS;
+}
+
+
+static uint64_t
+perfPool (void *cls)
+{
+  struct GNUNET_MemoryPool *pool = NULL;
+  void *live[SMALL_LIVE];
+  size_t i;
+
+  memset (live, 0, sizeof (live));
+  for (i=0;i<SMALL_ROUNDS;i++)
+    {
+      if (NULL != live[i % SMALL_LIVE])
+        GNUNET_pool_free (pool, live[i % SMALL_LIVE]);
+      live[i % SMALL_LIVE] = GNUNET_pool_malloc (pool, SMALL_SIZE);
+    }
+  for (i=0;i<SMALL_LIVE;i++)
+    GNUNET_pool_free (pool, live[i]);
+  GNUNET_pool_destroy (pool);
+  return SMALL_ROUNDS;
 }
 
 
 int
 main (int argc, char *argv[])
 {
-  struct GNUNET_TIME_Absolute start;
-  uint64_t kb;
-
-  start = GNUNET_TIME_absolute_get ();
-  kb = perfMalloc ();
-  printf ("Malloc perf took %s\n",
-          GNUNET_STRINGS_relative_time_to_string (GNUNET_TIME_absolute_get_duration (start),
-						  GNUNET_YES));
-  GAUGER ("UTIL", "Allocation",
-          kb / 1024 / (1 +
-		       GNUNET_TIME_absolute_get_duration
-		       (start).rel_value_us / 1000LL), "kb/ms");
-  return 0;
+  struct GNUNET_BENCHMARK_Suite *suite;
+
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_malloc");
+  GNUNET_BENCHMARK_run (suite, "Allocation", "kb", 10,
+                        &perfMalloc, NULL);
+  GNUNET_BENCHMARK_run (suite, "Small allocation", "allocs", 10,
+                        &perfSmallMalloc, NULL);
+  GNUNET_BENCHMARK_run (suite, "Pool allocation", "allocs", 10,
+                        &perfPool, NULL);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
 }
 
 /* end of perf_malloc.c */
@@ -0,0 +1,337 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @author Christian Grothoff
+ * @file util/perf_mq.c
+ * @brief measure performance of message queues and the message
+ *        stream tokenizer
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_benchmark_lib.h"
+
+/**
+ * Number of messages per repetition.
+ */
+#define MESSAGES (64 * 1024)
+
+/**
+ * Size of the messages given to the tokenizer.
+ */
+#define MST_MESSAGE_SIZE 64
+
+/**
+ * How much data we give to the tokenizer at once, deliberately
+ * not a multiple of #MST_MESSAGE_SIZE so that messages are split.
+ */
+#define MST_CHUNK_SIZE (GNUNET_SERVER_MAX_MESSAGE_SIZE - 1)
+
+
+/**
+ * Benchmark suite we report to.
+ */
+static struct GNUNET_BENCHMARK_Suite *suite;
+
+/**
+ * Message queue of the current repetition.
+ */
+static struct GNUNET_MQ_Handle *queue;
+
+/**
+ * When did the current repetition start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Number of messages the implementation received (or the handlers
+ * were called for) in the current repetition.
+ */
+static unsigned int received;
+
+
+/**
+ * The last message was sent, finish the repetition.
+ *
+ * @param cls name of the benchmark
+ */
+static void
+send_done (void *cls)
+{
+  const char *name = cls;
+
+  GNUNET_BENCHMARK_report (suite,
+                           name,
+                           "msgs",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           MESSAGES);
+  GNUNET_break (MESSAGES == received);
+  GNUNET_MQ_destroy (queue);
+  queue = NULL;
+}
+
+
+/**
+ * Send implementation that immediately completes.
+ *
+ * @param mq the message queue
+ * @param msg the message to send
+ * @param impl_state NULL
+ */
+static void
+send_impl (struct GNUNET_MQ_Handle *mq,
+           const struct GNUNET_MessageHeader *msg,
+           void *impl_state)
+{
+  received++;
+  GNUNET_MQ_impl_send_continue (mq);
+}
+
+
+/**
+ * Batched send implementation that immediately completes.
+ *
+ * @param mq the message queue
+ * @param msgs the messages to send
+ * @param count number of messages in @a msgs
+ * @param impl_state NULL
+ */
+static void
+send_batch_impl (struct GNUNET_MQ_Handle *mq,
+                 const struct GNUNET_MessageHeader *const *msgs,
+                 unsigned int count,
+                 void *impl_state)
+{
+  received += count;
+  GNUNET_MQ_impl_send_continue (mq);
+}
+
+
+/**
+ * Destroy implementation, we have no state.
+ *
+ * @param mq the message queue
+ * @param impl_state NULL
+ */
+static void
+destroy_impl (struct GNUNET_MQ_Handle *mq,
+              void *impl_state)
+{
+  /* nothing to do */
+}
+
+
+/**
+ * Queue all messages of a repetition.
+ *
+ * @param name name of the benchmark
+ */
+static void
+send_messages (const char *name)
+{
+  struct GNUNET_MQ_Envelope *env;
+  unsigned int i;
+
+  for (i=0;i<MESSAGES;i++)
+  {
+    env = GNUNET_MQ_msg_header (GNUNET_MESSAGE_TYPE_DUMMY);
+    if (MESSAGES - 1 == i)
+      GNUNET_MQ_notify_sent (env,
+                             &send_done,
+                             (void *) name);
+    GNUNET_MQ_send (queue,
+                    env);
+  }
+}
+
+
+/**
+ * Run a repetition of sending messages one at a time.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_send (void *cls,
+          const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  received = 0;
+  start = GNUNET_TIME_absolute_get ();
+  queue = GNUNET_MQ_queue_for_callbacks (&send_impl,
+                                         &destroy_impl,
+                                         NULL,
+                                         NULL,
+                                         NULL,
+                                         NULL,
+                                         NULL);
+  send_messages ("MQ send");
+}
+
+
+/**
+ * Run a repetition of sending messages in batches.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_send_batch (void *cls,
+                const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  received = 0;
+  start = GNUNET_TIME_absolute_get ();
+  queue = GNUNET_MQ_queue_for_callbacks_batched (&send_batch_impl,
+                                                 &destroy_impl,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL,
+                                                 NULL);
+  send_messages ("MQ batched send");
+}
+
+
+/**
+ * Handler for the dummy messages injected into the queue.
+ *
+ * @param cls NULL
+ * @param msg the message
+ */
+static void
+handle_dummy (void *cls,
+              const struct GNUNET_MessageHeader *msg)
+{
+  received++;
+}
+
+
+static uint64_t
+perfDispatch (void *cls)
+{
+  static const struct GNUNET_MQ_MessageHandler handlers[] = {
+    { &handle_dummy, GNUNET_MESSAGE_TYPE_DUMMY, sizeof (struct GNUNET_MessageHeader) },
+    GNUNET_MQ_HANDLERS_END
+  };
+  struct GNUNET_MessageHeader msg;
+  struct GNUNET_MQ_Handle *dq;
+  unsigned int i;
+
+  msg.size = htons (sizeof (msg));
+  msg.type = htons (GNUNET_MESSAGE_TYPE_DUMMY);
+  received = 0;
+  dq = GNUNET_MQ_queue_for_callbacks (&send_impl,
+                                      &destroy_impl,
+                                      NULL,
+                                      NULL,
+                                      handlers,
+                                      NULL,
+                                      NULL);
+  for (i=0;i<MESSAGES;i++)
+    GNUNET_MQ_inject_message (dq,
+                              &msg);
+  GNUNET_MQ_destroy (dq);
+  GNUNET_break (MESSAGES == received);
+  return MESSAGES;
+}
+
+
+/**
+ * Tokenizer callback.
+ *
+ * @param cls NULL
+ * @param client NULL
+ * @param message the message
+ * @return #GNUNET_OK
+ */
+static int
+mst_cb (void *cls,
+        void *client,
+        const struct GNUNET_MessageHeader *message)
+{
+  received++;
+  return GNUNET_OK;
+}
+
+
+static uint64_t
+perfTokenizer (void *cls)
+{
+  const char *buf = cls;
+  struct GNUNET_SERVER_MessageStreamTokenizer *mst;
+  size_t off;
+  size_t len;
+
+  received = 0;
+  mst = GNUNET_SERVER_mst_create (&mst_cb,
+                                  NULL);
+  for (off = 0; off < MESSAGES * MST_MESSAGE_SIZE; off += len)
+  {
+    len = GNUNET_MIN (MST_CHUNK_SIZE,
+                      MESSAGES * MST_MESSAGE_SIZE - off);
+    GNUNET_break (GNUNET_SYSERR !=
+                  GNUNET_SERVER_mst_receive (mst,
+                                             NULL,
+                                             &buf[off],
+                                             len,
+                                             GNUNET_NO,
+                                             GNUNET_NO));
+  }
+  GNUNET_SERVER_mst_destroy (mst);
+  GNUNET_break (MESSAGES == received);
+  return MESSAGES;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_MessageHeader *hdr;
+  char *buf;
+  unsigned int repetitions;
+  unsigned int i;
+
+  GNUNET_log_setup ("perf-mq",
+                    "WARNING",
+                    NULL);
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_mq");
+  repetitions = GNUNET_BENCHMARK_get_repetitions (10);
+  for (i=0;i<repetitions;i++)
+    GNUNET_SCHEDULER_run (&run_send,
+                          NULL);
+  for (i=0;i<repetitions;i++)
+    GNUNET_SCHEDULER_run (&run_send_batch,
+                          NULL);
+  GNUNET_BENCHMARK_run (suite, "MQ dispatch", "msgs", 10,
+                        &perfDispatch, NULL);
+
+  buf = GNUNET_malloc (MESSAGES * MST_MESSAGE_SIZE);
+  for (i=0;i<MESSAGES;i++)
+  {
+    hdr = (struct GNUNET_MessageHeader *) &buf[i * MST_MESSAGE_SIZE];
+    hdr->size = htons (MST_MESSAGE_SIZE);
+    hdr->type = htons (GNUNET_MESSAGE_TYPE_DUMMY);
+  }
+  GNUNET_BENCHMARK_run (suite, "MST tokenize", "msgs", 10,
+                        &perfTokenizer, buf);
+  GNUNET_free (buf);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
+}
+
+/* end of perf_mq.c */
@@ -0,0 +1,174 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @author Christian Grothoff
+ * @file util/perf_scheduler.c
+ * @brief measure performance of scheduling and running tasks
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_benchmark_lib.h"
+
+/**
+ * Number of tasks run per repetition.
+ */
+#define TASKS (64 * 1024)
+
+
+/**
+ * Benchmark suite we report to.
+ */
+static struct GNUNET_BENCHMARK_Suite *suite;
+
+/**
+ * When did the current repetition start?
+ */
+static struct GNUNET_TIME_Absolute start;
+
+/**
+ * Number of tasks that still have to run in the current repetition.
+ */
+static unsigned int remaining;
+
+/**
+ * Tasks scheduled by #run_cancel(), to be cancelled again.
+ */
+static struct GNUNET_SCHEDULER_Task *tasks[TASKS];
+
+
+/**
+ * Task run by the benchmarks, reports once the last one ran.
+ *
+ * @param cls name of the benchmark, NULL to schedule the next
+ *        task of a chain
+ * @param tc scheduler context
+ */
+static void
+count_task (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  const char *name = cls;
+
+  if (0 == --remaining)
+  {
+    GNUNET_BENCHMARK_report (suite,
+                             (NULL == name) ? "Scheduler add_now chain" : name,
+                             "tasks",
+                             GNUNET_TIME_absolute_get_duration (start),
+                             TASKS);
+    return;
+  }
+  if (NULL == name)
+    GNUNET_SCHEDULER_add_now (&count_task,
+                              NULL);
+}
+
+
+/**
+ * Run a repetition where each task schedules the next one.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_chain (void *cls,
+           const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  remaining = TASKS;
+  start = GNUNET_TIME_absolute_get ();
+  GNUNET_SCHEDULER_add_now (&count_task,
+                            NULL);
+}
+
+
+/**
+ * Run a repetition where all tasks are scheduled at once.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_fanout (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  unsigned int i;
+
+  remaining = TASKS;
+  start = GNUNET_TIME_absolute_get ();
+  for (i=0;i<TASKS;i++)
+    GNUNET_SCHEDULER_add_now (&count_task,
+                              "Scheduler add_now fan-out");
+}
+
+
+/**
+ * Run a repetition where timeout tasks are scheduled and cancelled
+ * again, as done for most request timeouts.
+ *
+ * @param cls NULL
+ * @param tc scheduler context
+ */
+static void
+run_cancel (void *cls,
+            const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  unsigned int i;
+
+  start = GNUNET_TIME_absolute_get ();
+  for (i=0;i<TASKS;i++)
+    tasks[i] = GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_SECONDS,
+                                                                            1 + i % 60),
+                                             &count_task,
+                                             NULL);
+  for (i=0;i<TASKS;i++)
+    GNUNET_SCHEDULER_cancel (tasks[i]);
+  GNUNET_BENCHMARK_report (suite,
+                           "Scheduler add_delayed/cancel",
+                           "tasks",
+                           GNUNET_TIME_absolute_get_duration (start),
+                           TASKS);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  unsigned int repetitions;
+  unsigned int i;
+
+  GNUNET_log_setup ("perf-scheduler",
+                    "WARNING",
+                    NULL);
+  suite = GNUNET_BENCHMARK_suite_create ("UTIL", "perf_scheduler");
+  repetitions = GNUNET_BENCHMARK_get_repetitions (10);
+  for (i=0;i<repetitions;i++)
+    GNUNET_SCHEDULER_run (&run_chain,
+                          NULL);
+  for (i=0;i<repetitions;i++)
+    GNUNET_SCHEDULER_run (&run_fanout,
+                          NULL);
+  for (i=0;i<repetitions;i++)
+    GNUNET_SCHEDULER_run (&run_cancel,
+                          NULL);
+  return (GNUNET_OK == GNUNET_BENCHMARK_suite_destroy (suite)) ? 0 : 1;
+}
+
+/* end of perf_scheduler.c */
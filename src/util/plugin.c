@@ -46,9 +46,14 @@ struct PluginList
   char *name;
 
   /**
-   * System handle.
+   * System handle, NULL for compiled-in plugins.
    */
   void *handle;
+
+  /**
+   * The "done" function of the plugin, resolved when it was loaded.
+   */
+  GNUNET_PLUGIN_Callback done;
 };
 
 
@@ -67,6 +72,43 @@ static char *old_dlsearchpath;
  */
 static struct PluginList *plugins;
 
+/**
+ * Plugins that were compiled in (see #GNUNET_PLUGIN_STATIC).
+ */
+static struct GNUNET_PLUGIN_StaticPlugin *static_plugins;
+
+
+/**
+ * Register a compiled-in plugin.
+ *
+ * @param sp plugin to register, must remain valid
+ */
+void
+GNUNET_PLUGIN_register_static (struct GNUNET_PLUGIN_StaticPlugin *sp)
+{
+  sp->next = static_plugins;
+  static_plugins = sp;
+}
+
+
+/**
+ * Find a compiled-in plugin.
+ *
+ * @param library_name name of the plugin
+ * @return NULL if @a library_name is not compiled in
+ */
+static const struct GNUNET_PLUGIN_StaticPlugin *
+find_static (const char *library_name)
+{
+  const struct GNUNET_PLUGIN_StaticPlugin *sp;
+
+  for (sp = static_plugins; NULL != sp; sp = sp->next)
+    if (0 == strcmp (sp->library_name,
+                     library_name))
+      return sp;
+  return NULL;
+}
+
 
 /**
  * Setup libtool paths.
@@ -172,6 +214,8 @@ GNUNET_PLUGIN_test (const char *library_name)
   GNUNET_PLUGIN_Callback init;
   struct PluginList plug;
 
+  if (NULL != find_static (library_name))
+    return GNUNET_YES;
   if (! initialized)
   {
     initialized = GNUNET_YES;
@@ -211,9 +255,21 @@ GNUNET_PLUGIN_load (const char *library_name, void *arg)
 {
   void *libhandle;
   struct PluginList *plug;
+  const struct GNUNET_PLUGIN_StaticPlugin *sp;
   GNUNET_PLUGIN_Callback init;
   void *ret;
 
+  if (NULL != (sp = find_static (library_name)))
+  {
+    if (NULL == (ret = sp->init (arg)))
+      return NULL;
+    plug = GNUNET_new (struct PluginList);
+    plug->name = GNUNET_strdup (library_name);
+    plug->done = sp->done;
+    plug->next = plugins;
+    plugins = plug;
+    return ret;
+  }
   if (!initialized)
   {
     initialized = GNUNET_YES;
@@ -242,6 +298,7 @@ GNUNET_PLUGIN_load (const char *library_name, void *arg)
     GNUNET_free (plug);
     return NULL;
   }
+  plug->done = resolve_function (plug, "done");
   return ret;
 }
 
@@ -273,7 +330,7 @@ GNUNET_PLUGIN_unload (const char *library_name,
   if (NULL == pos)
     return NULL;
 
-  done = resolve_function (pos, "done");
+  done = pos->done;
   ret = NULL;
   if (NULL != done)
     ret = done (arg);
@@ -281,10 +338,12 @@ GNUNET_PLUGIN_unload (const char *library_name,
     plugins = pos->next;
   else
     prev->next = pos->next;
-  lt_dlclose (pos->handle);
+  if (NULL != pos->handle)
+    lt_dlclose (pos->handle);
   GNUNET_free (pos->name);
   GNUNET_free (pos);
-  if (NULL == plugins)
+  if ( (NULL == plugins) &&
+       (initialized) )
   {
     plugin_fini ();
     initialized = GNUNET_NO;
@@ -351,6 +410,12 @@ find_libraries (void *cls, const char *filename)
   basename = GNUNET_strdup (libname);
   if (NULL != (dot = strstr (basename, ".")))
     *dot = '\0';
+  if (NULL != find_static (basename))
+  {
+    /* already loaded the compiled-in version */
+    GNUNET_free (basename);
+    return GNUNET_OK;
+  }
   lib_ret = GNUNET_PLUGIN_load (basename, lac->arg);
   if (NULL != lib_ret)
     lac->cb (lac->cb_cls, basename, lib_ret);
@@ -376,8 +441,20 @@ GNUNET_PLUGIN_load_all (const char *basename, void *arg,
                         GNUNET_PLUGIN_LoaderCallback cb, void *cb_cls)
 {
   struct LoadAllContext lac;
+  const struct GNUNET_PLUGIN_StaticPlugin *sp;
+  void *lib_ret;
   char *path;
 
+  for (sp = static_plugins; NULL != sp; sp = sp->next)
+  {
+    if (0 != strncmp (basename,
+                      sp->library_name,
+                      strlen (basename)))
+      continue;
+    lib_ret = GNUNET_PLUGIN_load (sp->library_name, arg);
+    if (NULL != lib_ret)
+      cb (cb_cls, sp->library_name, lib_ret);
+  }
   path = GNUNET_OS_installation_get_path (GNUNET_OS_IPK_LIBDIR);
   if (NULL == path)
   {
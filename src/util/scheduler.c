@@ -69,6 +69,56 @@
  */
 #define DELAY_THRESHOLD GNUNET_TIME_UNIT_SECONDS
 
+/**
+ * Should we use epoll() to wait for tasks that are waiting on a
+ * single file descriptor?  If set, such file descriptors are
+ * registered with the kernel once when the task is added instead of
+ * being added to the select() sets in every iteration.  Tasks that
+ * wait on entire FD sets (#GNUNET_SCHEDULER_add_select) always use
+ * select().
+ */
+#if HAVE_SYS_EPOLL_H
+#define USE_EPOLL GNUNET_YES
+#include <sys/epoll.h>
+#else
+#define USE_EPOLL GNUNET_NO
+#endif
+
+/**
+ * Maximum number of events we obtain from the kernel in one
+ * epoll_wait() call.
+ */
+#define EPOLL_MAX_EVENTS 128
+
+/**
+ * Number of bits of a tick (in ms) that select the slot within one
+ * level of the timer wheel.
+ */
+#define WHEEL_BITS 6
+
+/**
+ * Number of slots per level of the timer wheel.
+ */
+#define WHEEL_SIZE (1 << WHEEL_BITS)
+
+/**
+ * Number of levels of the timer wheel.  Level 0 has a resolution
+ * of 1 ms; with 4 levels of 64 slots, timeouts up to about 4.6
+ * hours are kept in the wheel, longer ones in #WHEEL_OVERFLOW.
+ */
+#define WHEEL_LEVELS 4
+
+/**
+ * Position in #wheel of tasks whose timeout is beyond the last
+ * level of the wheel.
+ */
+#define WHEEL_OVERFLOW (WHEEL_LEVELS * WHEEL_SIZE + 1)
+
+/**
+ * Position in #wheel of tasks that only run on shutdown.
+ */
+#define WHEEL_FOREVER (WHEEL_OVERFLOW + 1)
+
 
 /**
  * Entry in list of pending tasks.
@@ -123,6 +173,12 @@ struct GNUNET_SCHEDULER_Task
   struct GNUNET_TIME_Absolute start_time;
 #endif
 
+  /**
+   * When was the task put into the ready queue?  Only set while
+   * profiling is enabled, zero otherwise.
+   */
+  struct GNUNET_TIME_Absolute ready_time;
+
   /**
    * Why is the task ready?  Set after task is added to ready queue.
    * Initially set to zero.  All reasons that have already been
@@ -156,6 +212,28 @@ struct GNUNET_SCHEDULER_Task
    */
   int in_ready_list;
 
+  /**
+   * Position of the task in #wheel, 0 if the task is not in the
+   * timer wheel.  While set, @e next and @e prev refer to the list
+   * of tasks of that slot.
+   */
+  unsigned int wheel_pos;
+
+#if USE_EPOLL
+  /**
+   * Entry for the file descriptor this task is waiting on if the
+   * task is registered with epoll, otherwise NULL.  While set,
+   * @e next and @e prev refer to the list of tasks of that entry.
+   */
+  struct EpollEntry *epoll_entry;
+
+  /**
+   * Node in #epoll_timeouts if the task is registered with epoll
+   * and has a finite timeout, otherwise NULL.
+   */
+  struct GNUNET_CONTAINER_HeapNode *timeout_node;
+#endif
+
 #if EXECINFO
   /**
    * Array of strings which make up a backtrace from the point when this
@@ -173,6 +251,63 @@ struct GNUNET_SCHEDULER_Task
 };
 
 
+/**
+ * Slot of the timer wheel.
+ */
+struct WheelSlot
+{
+
+  /**
+   * Head of the list of tasks in this slot.
+   */
+  struct GNUNET_SCHEDULER_Task *head;
+
+  /**
+   * Tail of the list of tasks in this slot.
+   */
+  struct GNUNET_SCHEDULER_Task *tail;
+
+};
+
+
+#if USE_EPOLL
+/**
+ * File descriptor registered with epoll, together with the
+ * tasks waiting on it.
+ */
+struct EpollEntry
+{
+
+  /**
+   * Head of the list of tasks waiting on @e fd.
+   */
+  struct GNUNET_SCHEDULER_Task *head;
+
+  /**
+   * Tail of the list of tasks waiting on @e fd.
+   */
+  struct GNUNET_SCHEDULER_Task *tail;
+
+  /**
+   * The file descriptor.
+   */
+  int fd;
+
+  /**
+   * Events the kernel currently reports for @e fd, 0 if @e fd
+   * is not registered.
+   */
+  uint32_t events;
+
+};
+#endif
+
+
+/**
+ * Pool the `struct GNUNET_SCHEDULER_Task`s are allocated from.
+ */
+static struct GNUNET_MemoryPool *task_pool;
+
 /**
  * Head of list of tasks waiting for an event.
  */
@@ -207,6 +342,44 @@ static struct GNUNET_SCHEDULER_Task *pending_timeout_tail;
  */
 static struct GNUNET_SCHEDULER_Task *pending_timeout_last;
 
+/**
+ * Hierarchical timer wheel for tasks waiting ONLY for a timeout
+ * event (with a non-zero delay).  Position 0 is unused, followed
+ * by #WHEEL_SIZE slots for each of the #WHEEL_LEVELS levels and
+ * the #WHEEL_OVERFLOW and #WHEEL_FOREVER lists.  Slot @e i of
+ * level @e l holds the tasks whose timeout (in ms) has digit @e i
+ * at that level and that agree with #wheel_now in all higher
+ * digits.
+ */
+static struct WheelSlot wheel[WHEEL_FOREVER + 1];
+
+/**
+ * Bitmap of the non-empty slots, per level of #wheel.
+ */
+static uint64_t wheel_used[WHEEL_LEVELS];
+
+/**
+ * Current tick (in ms) of the timer wheel.  All slots for earlier
+ * ticks have been expired.
+ */
+static uint64_t wheel_now;
+
+/**
+ * Number of tasks in #wheel.
+ */
+static unsigned int wheel_task_count;
+
+/**
+ * Number of tasks in #wheel that count for lifeness.
+ */
+static unsigned int wheel_lifeness_count;
+
+/**
+ * Should delayed tasks be kept in #wheel?  If not, they are kept
+ * in the sorted #pending_timeout_head list.
+ */
+static int use_wheel = GNUNET_YES;
+
 /**
  * ID of the task that is running right now.
  */
@@ -232,6 +405,16 @@ static unsigned int ready_count;
  */
 static unsigned long long tasks_run;
 
+/**
+ * Are we collecting per-task accounting in #profile?
+ */
+static int profiling;
+
+/**
+ * Accounting for the tasks run since profiling was enabled.
+ */
+static struct GNUNET_SCHEDULER_Profile profile;
+
 /**
  * Priority of the task running right now.  Only
  * valid while a task is running.
@@ -260,6 +443,41 @@ static GNUNET_SCHEDULER_select scheduler_select;
  */
 static void *scheduler_select_cls;
 
+#if USE_EPOLL
+/**
+ * Our epoll handle, -1 if we are using select() only.
+ */
+static int epoll_fd = -1;
+
+/**
+ * Map from file descriptors (as `uint32_t`) to the respective
+ * `struct EpollEntry`.  Entries are kept until the scheduler
+ * terminates as file descriptors are typically reused.
+ */
+static struct GNUNET_CONTAINER_MultiHashMap32 *epoll_entries;
+
+/**
+ * Heap of tasks registered with epoll that have a finite timeout,
+ * sorted by timeout (earliest first).
+ */
+static struct GNUNET_CONTAINER_Heap *epoll_timeouts;
+
+/**
+ * Number of tasks registered with epoll.
+ */
+static unsigned int epoll_task_count;
+
+/**
+ * Number of tasks registered with epoll that count for lifeness.
+ */
+static unsigned int epoll_lifeness_count;
+
+/**
+ * Read end of the shutdown pipe, registered with epoll.
+ */
+static int epoll_pipe_fd = -1;
+#endif
+
 
 /**
  * Sets the select function to use in the scheduler (scheduler_select).
@@ -277,6 +495,133 @@ GNUNET_SCHEDULER_set_select (GNUNET_SCHEDULER_select new_select,
 }
 
 
+/**
+ * Select how the scheduler keeps track of tasks that wait for a
+ * timeout.
+ *
+ * @param new_use_wheel #GNUNET_YES to use the timer wheel (default),
+ *        #GNUNET_NO to use a sorted list
+ */
+void
+GNUNET_SCHEDULER_set_timer_wheel (int new_use_wheel)
+{
+  GNUNET_assert (0 == wheel_task_count);
+  GNUNET_assert (NULL == pending_timeout_head);
+  use_wheel = new_use_wheel;
+}
+
+
+/**
+ * Enable or disable per-task accounting.  While enabled, the
+ * scheduler measures how long each task waits in the ready queue and
+ * how long it runs.  Enabling profiling resets the accounting.
+ *
+ * @param enable #GNUNET_YES to enable profiling, #GNUNET_NO to disable it
+ */
+void
+GNUNET_SCHEDULER_set_profiling (int enable)
+{
+  if ( (GNUNET_YES == enable) &&
+       (GNUNET_YES != profiling) )
+    memset (&profile, 0, sizeof (profile));
+  profiling = enable;
+}
+
+
+/**
+ * Obtain the accounting collected since profiling was enabled.
+ *
+ * @return NULL if profiling is disabled
+ */
+const struct GNUNET_SCHEDULER_Profile *
+GNUNET_SCHEDULER_get_profile ()
+{
+  if (GNUNET_YES != profiling)
+    return NULL;
+  return &profile;
+}
+
+
+/**
+ * Find the histogram bucket for the given time.
+ *
+ * @param t time to classify
+ * @return bucket index in `struct GNUNET_SCHEDULER_Profile`
+ */
+static unsigned int
+profile_bucket (struct GNUNET_TIME_Relative t)
+{
+  uint64_t limit;
+  unsigned int i;
+
+  limit = 100;
+  for (i = 0; i < GNUNET_SCHEDULER_PROFILE_BUCKETS - 1; i++)
+  {
+    if (t.rel_value_us < limit)
+      return i;
+    limit *= 10;
+  }
+  return GNUNET_SCHEDULER_PROFILE_BUCKETS - 1;
+}
+
+
+/**
+ * Account for a task that was just run.
+ *
+ * @param t the task
+ * @param p priority the task was run with
+ * @param latency how long the task waited in the ready queue
+ * @param duration how long the task ran
+ */
+static void
+profile_task (const struct GNUNET_SCHEDULER_Task *t,
+              enum GNUNET_SCHEDULER_Priority p,
+              struct GNUNET_TIME_Relative latency,
+              struct GNUNET_TIME_Relative duration)
+{
+  struct GNUNET_SCHEDULER_TaskProfile *tp;
+  unsigned int pos;
+
+  profile.latency[p][profile_bucket (latency)]++;
+  profile.duration[p][profile_bucket (duration)]++;
+  profile.max_latency[p] = GNUNET_TIME_relative_max (profile.max_latency[p],
+                                                     latency);
+  for (pos = 0; pos < profile.slowest_count; pos++)
+    if (duration.rel_value_us > profile.slowest[pos].duration.rel_value_us)
+      break;
+  if (GNUNET_SCHEDULER_PROFILE_SLOWEST == pos)
+    return;
+  if (GNUNET_SCHEDULER_PROFILE_SLOWEST > profile.slowest_count)
+    profile.slowest_count++;
+  memmove (&profile.slowest[pos + 1],
+           &profile.slowest[pos],
+           (profile.slowest_count - pos - 1) * sizeof (struct GNUNET_SCHEDULER_TaskProfile));
+  tp = &profile.slowest[pos];
+  tp->callback = t->callback;
+  tp->priority = p;
+  tp->latency = latency;
+  tp->duration = duration;
+  tp->location[0] = '\0';
+#if EXECINFO
+  {
+    int i;
+
+    /* report the first frame outside of the scheduler API */
+    for (i = 1; i < t->num_backtrace_strings; i++)
+    {
+      if (NULL != strstr (t->backtrace_strings[i], "GNUNET_SCHEDULER_"))
+        continue;
+      strncpy (tp->location,
+               t->backtrace_strings[i],
+               sizeof (tp->location) - 1);
+      tp->location[sizeof (tp->location) - 1] = '\0';
+      break;
+    }
+  }
+#endif
+}
+
+
 /**
  * Check that the given priority is legal (and return it).
  *
@@ -293,6 +638,230 @@ check_priority (enum GNUNET_SCHEDULER_Priority p)
 }
 
 
+/**
+ * Check if there are tasks waiting for file descriptors to become
+ * ready.
+ *
+ * @return #GNUNET_YES if so, #GNUNET_NO if not
+ */
+static int
+have_pending_io ()
+{
+#if USE_EPOLL
+  if (0 < epoll_task_count)
+    return GNUNET_YES;
+#endif
+  return (NULL != pending_head) ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * Find the lowest bit set in a bitmap.
+ *
+ * @param bits non-zero bitmap
+ * @return index of the lowest bit set in @a bits
+ */
+static unsigned int
+lowest_bit (uint64_t bits)
+{
+  unsigned int i;
+
+  for (i = 0; 0 == (bits & 1); i++)
+    bits >>= 1;
+  return i;
+}
+
+
+/**
+ * Add a task to the slot of #wheel matching its timeout.
+ *
+ * @param t task to add
+ */
+static void
+wheel_link (struct GNUNET_SCHEDULER_Task *t)
+{
+  struct WheelSlot *slot;
+  uint64_t tick;
+  unsigned int level;
+  unsigned int idx;
+
+  t->wheel_pos = WHEEL_OVERFLOW;
+  if (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us == t->timeout.abs_value_us)
+    t->wheel_pos = WHEEL_FOREVER;
+  else
+  {
+    tick = GNUNET_MAX (t->timeout.abs_value_us / 1000LL,
+                       wheel_now);
+    for (level = 0; level < WHEEL_LEVELS; level++)
+    {
+      if ( (tick >> (WHEEL_BITS * (level + 1))) !=
+           (wheel_now >> (WHEEL_BITS * (level + 1))) )
+        continue;
+      idx = (tick >> (WHEEL_BITS * level)) & (WHEEL_SIZE - 1);
+      wheel_used[level] |= 1LLU << idx;
+      t->wheel_pos = 1 + level * WHEEL_SIZE + idx;
+      break;
+    }
+  }
+  slot = &wheel[t->wheel_pos];
+  GNUNET_CONTAINER_DLL_insert_tail (slot->head,
+                                    slot->tail,
+                                    t);
+}
+
+
+/**
+ * Remove a task from its slot of #wheel.
+ *
+ * @param t task to remove
+ */
+static void
+wheel_unlink (struct GNUNET_SCHEDULER_Task *t)
+{
+  struct WheelSlot *slot = &wheel[t->wheel_pos];
+  unsigned int off;
+
+  GNUNET_CONTAINER_DLL_remove (slot->head,
+                               slot->tail,
+                               t);
+  if ( (NULL == slot->head) &&
+       (t->wheel_pos < WHEEL_OVERFLOW) )
+  {
+    off = t->wheel_pos - 1;
+    wheel_used[off / WHEEL_SIZE] &= ~(1LLU << (off % WHEEL_SIZE));
+  }
+  t->wheel_pos = 0;
+}
+
+
+/**
+ * Add a delayed task to the timer wheel.
+ *
+ * @param t task to add
+ */
+static void
+wheel_add_task (struct GNUNET_SCHEDULER_Task *t)
+{
+  unsigned int level;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+    if (0 != wheel_used[level])
+      break;
+  if ( (WHEEL_LEVELS == level) &&
+       (NULL == wheel[WHEEL_OVERFLOW].head) )
+    wheel_now = GNUNET_TIME_absolute_get ().abs_value_us / 1000LL;
+  wheel_link (t);
+  wheel_task_count++;
+  if (GNUNET_YES == t->lifeness)
+    wheel_lifeness_count++;
+}
+
+
+/**
+ * Remove a delayed task from the timer wheel.
+ *
+ * @param t task to remove
+ */
+static void
+wheel_remove_task (struct GNUNET_SCHEDULER_Task *t)
+{
+  wheel_unlink (t);
+  wheel_task_count--;
+  if (GNUNET_YES == t->lifeness)
+    wheel_lifeness_count--;
+}
+
+
+/**
+ * Find the next tick after #wheel_now at which the timer wheel
+ * must expire a slot or move tasks down to a lower level.
+ *
+ * @return the tick, UINT64_MAX if there is nothing to do
+ */
+static uint64_t
+wheel_next_tick ()
+{
+  unsigned int level;
+  unsigned int shift;
+  unsigned int idx;
+  uint64_t bits;
+
+  for (level = 0; level < WHEEL_LEVELS; level++)
+  {
+    shift = WHEEL_BITS * level;
+    idx = (wheel_now >> shift) & (WHEEL_SIZE - 1);
+    bits = (WHEEL_SIZE - 1 == idx) ? 0 : (wheel_used[level] & (~0LLU << (idx + 1)));
+    if (0 != bits)
+      return ((wheel_now >> shift) + (lowest_bit (bits) - idx)) << shift;
+    if ( (0 == level) &&
+         (0 != wheel_used[0]) )
+    {
+      /* only tasks left behind by a clock that went backwards */
+      return (wheel_now | (WHEEL_SIZE - 1)) + 1;
+    }
+  }
+  if (NULL != wheel[WHEEL_OVERFLOW].head)
+    return (wheel_now | ((1LLU << (WHEEL_BITS * WHEEL_LEVELS)) - 1)) + 1;
+  return UINT64_MAX;
+}
+
+
+/**
+ * Determine the earliest time at which the scheduler must look at
+ * the timer wheel again.
+ *
+ * @return time of the next timeout in the wheel (or of the next
+ *         step of the wheel, whichever is earlier)
+ */
+static struct GNUNET_TIME_Absolute
+wheel_get_timeout ()
+{
+  struct GNUNET_TIME_Absolute ret;
+  struct GNUNET_SCHEDULER_Task *pos;
+  unsigned int idx;
+  uint64_t bits;
+  uint64_t tick;
+
+  idx = wheel_now & (WHEEL_SIZE - 1);
+  bits = wheel_used[0] & (~0LLU << idx);
+  if (0 != bits)
+  {
+    ret = GNUNET_TIME_UNIT_FOREVER_ABS;
+    for (pos = wheel[1 + lowest_bit (bits)].head; NULL != pos; pos = pos->next)
+      ret = GNUNET_TIME_absolute_min (ret,
+                                      pos->timeout);
+    return ret;
+  }
+  tick = wheel_next_tick ();
+  if (UINT64_MAX == tick)
+    return GNUNET_TIME_UNIT_FOREVER_ABS;
+  ret.abs_value_us = tick * 1000LL;
+  return ret;
+}
+
+
+/**
+ * Move all tasks in the timer wheel to the list of tasks waiting
+ * for a timeout, marking them as ready due to shutdown.
+ */
+static void
+wheel_shutdown ()
+{
+  struct GNUNET_SCHEDULER_Task *pos;
+  unsigned int i;
+
+  for (i = 1; i <= WHEEL_FOREVER; i++)
+    while (NULL != (pos = wheel[i].head))
+    {
+      wheel_remove_task (pos);
+      pos->reason |= GNUNET_SCHEDULER_REASON_SHUTDOWN;
+      GNUNET_CONTAINER_DLL_insert (pending_timeout_head,
+                                   pending_timeout_tail,
+                                   pos);
+    }
+}
+
+
 /**
  * Update all sets and timeout for select.
  *
@@ -319,6 +888,22 @@ update_sets (struct GNUNET_NETWORK_FDSet *rs,
     if (0 != pos->reason)
       *timeout = GNUNET_TIME_UNIT_ZERO;
   }
+  if (0 < wheel_task_count)
+  {
+    to = GNUNET_TIME_absolute_get_difference (now,
+                                              wheel_get_timeout ());
+    if (timeout->rel_value_us > to.rel_value_us)
+      *timeout = to;
+  }
+#if USE_EPOLL
+  if ( (NULL != epoll_timeouts) &&
+       (NULL != (pos = GNUNET_CONTAINER_heap_peek (epoll_timeouts))) )
+  {
+    to = GNUNET_TIME_absolute_get_difference (now, pos->timeout);
+    if (timeout->rel_value_us > to.rel_value_us)
+      *timeout = to;
+  }
+#endif
   for (pos = pending_head; NULL != pos; pos = pos->next)
   {
     if (pos->timeout.abs_value_us != GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us)
@@ -422,10 +1007,450 @@ queue_ready_task (struct GNUNET_SCHEDULER_Task *task)
                                ready_tail[p],
                                task);
   task->in_ready_list = GNUNET_YES;
+  if (GNUNET_YES == profiling)
+    task->ready_time = GNUNET_TIME_absolute_get ();
   ready_count++;
 }
 
 
+/**
+ * Move tasks of the current level 0 slot of the timer wheel that
+ * have timed out to the ready queue.
+ *
+ * @param now the current time
+ */
+static void
+wheel_expire (struct GNUNET_TIME_Absolute now)
+{
+  struct GNUNET_SCHEDULER_Task *pos;
+  struct GNUNET_SCHEDULER_Task *next;
+
+  next = wheel[1 + (wheel_now & (WHEEL_SIZE - 1))].head;
+  while (NULL != (pos = next))
+  {
+    next = pos->next;
+    if (now.abs_value_us < pos->timeout.abs_value_us)
+      continue;
+    wheel_remove_task (pos);
+    pos->reason |= GNUNET_SCHEDULER_REASON_TIMEOUT;
+    queue_ready_task (pos);
+  }
+}
+
+
+/**
+ * Redistribute the tasks of the given slot of #wheel relative to
+ * the (new) #wheel_now.
+ *
+ * @param pos position of the slot in #wheel
+ */
+static void
+wheel_cascade (unsigned int pos)
+{
+  struct GNUNET_SCHEDULER_Task *head;
+  struct GNUNET_SCHEDULER_Task *t;
+  unsigned int off;
+
+  head = wheel[pos].head;
+  wheel[pos].head = NULL;
+  wheel[pos].tail = NULL;
+  if (pos < WHEEL_OVERFLOW)
+  {
+    off = pos - 1;
+    wheel_used[off / WHEEL_SIZE] &= ~(1LLU << (off % WHEEL_SIZE));
+  }
+  while (NULL != (t = head))
+  {
+    head = t->next;
+    t->next = NULL;
+    t->prev = NULL;
+    wheel_link (t);
+  }
+}
+
+
+/**
+ * Advance the timer wheel to the current time, moving all tasks
+ * that timed out to the ready queue.
+ *
+ * @param now the current time
+ */
+static void
+wheel_advance (struct GNUNET_TIME_Absolute now)
+{
+  uint64_t now_ms;
+  uint64_t next;
+  unsigned int level;
+  unsigned int shift;
+
+  now_ms = now.abs_value_us / 1000LL;
+  while (1)
+  {
+    wheel_expire (now);
+    if (wheel_now >= now_ms)
+      return;
+    next = wheel_next_tick ();
+    if (next > now_ms)
+    {
+      /* nothing happens in between, skip ahead */
+      wheel_now = now_ms;
+      continue;
+    }
+    wheel_now = next;
+    if (0 == (wheel_now & ((1LLU << (WHEEL_BITS * WHEEL_LEVELS)) - 1)))
+      wheel_cascade (WHEEL_OVERFLOW);
+    for (level = WHEEL_LEVELS - 1; level > 0; level--)
+    {
+      shift = WHEEL_BITS * level;
+      if (0 != (wheel_now & ((1LLU << shift) - 1)))
+        continue;
+      wheel_cascade (1 + level * WHEEL_SIZE
+                     + ((wheel_now >> shift) & (WHEEL_SIZE - 1)));
+    }
+  }
+}
+
+
+#if USE_EPOLL
+/**
+ * Synchronize the set of events the kernel monitors for the file
+ * descriptor of @a entry with the tasks currently waiting on it.
+ *
+ * @param entry entry to synchronize
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if the kernel
+ *         refused (i.e. because the descriptor is a regular file)
+ */
+static int
+epoll_sync_entry (struct EpollEntry *entry)
+{
+  struct GNUNET_SCHEDULER_Task *pos;
+  struct epoll_event ev;
+  uint32_t events;
+  int op;
+
+  events = 0;
+  for (pos = entry->head; NULL != pos; pos = pos->next)
+  {
+    if (-1 != pos->read_fd)
+      events |= EPOLLIN;
+    if (-1 != pos->write_fd)
+      events |= EPOLLOUT;
+  }
+  if (events == entry->events)
+    return GNUNET_OK;
+  memset (&ev, 0, sizeof (ev));
+  ev.events = events;
+  ev.data.ptr = entry;
+  if (0 == events)
+    op = EPOLL_CTL_DEL;
+  else if (0 == entry->events)
+    op = EPOLL_CTL_ADD;
+  else
+    op = EPOLL_CTL_MOD;
+  if ( (0 != epoll_ctl (epoll_fd, op, entry->fd, &ev)) &&
+       (! ( (EPOLL_CTL_DEL == op) &&
+            ( (ENOENT == errno) || (EBADF == errno) ) ) ) )
+  {
+    /* The kernel drops descriptors from the epoll set when they are
+       closed, so our view may be outdated if the number was reused. */
+    if ( (EPOLL_CTL_ADD == op) && (EEXIST == errno) )
+      op = EPOLL_CTL_MOD;
+    else if ( (EPOLL_CTL_MOD == op) && (ENOENT == errno) )
+      op = EPOLL_CTL_ADD;
+    else
+      op = -1;
+    if ( (-1 == op) ||
+         (0 != epoll_ctl (epoll_fd, op, entry->fd, &ev)) )
+    {
+      if (EPERM != errno)
+        LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING,
+                      "epoll_ctl");
+      return GNUNET_SYSERR;
+    }
+  }
+  entry->events = events;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Try to register a task that waits on a single file descriptor
+ * with epoll.
+ *
+ * @param t task to register
+ * @return #GNUNET_YES if @a t is now registered with epoll,
+ *         #GNUNET_NO if it must be handled by select()
+ */
+static int
+epoll_add_task (struct GNUNET_SCHEDULER_Task *t)
+{
+  struct EpollEntry *entry;
+  int fd;
+
+  if (-1 == epoll_fd)
+    return GNUNET_NO;
+  fd = (-1 != t->read_fd) ? t->read_fd : t->write_fd;
+  if ( (-1 == fd) ||
+       ( (-1 != t->write_fd) &&
+         (fd != t->write_fd) ) )
+    return GNUNET_NO;
+  entry = GNUNET_CONTAINER_multihashmap32_get (epoll_entries,
+                                               (uint32_t) fd);
+  if (NULL == entry)
+  {
+    entry = GNUNET_new (struct EpollEntry);
+    entry->fd = fd;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_CONTAINER_multihashmap32_put (epoll_entries,
+                                                        (uint32_t) fd,
+                                                        entry,
+                                                        GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  GNUNET_CONTAINER_DLL_insert (entry->head,
+                               entry->tail,
+                               t);
+  if (GNUNET_OK != epoll_sync_entry (entry))
+  {
+    GNUNET_CONTAINER_DLL_remove (entry->head,
+                                 entry->tail,
+                                 t);
+    return GNUNET_NO;
+  }
+  t->epoll_entry = entry;
+  if (GNUNET_TIME_UNIT_FOREVER_ABS.abs_value_us != t->timeout.abs_value_us)
+    t->timeout_node = GNUNET_CONTAINER_heap_insert (epoll_timeouts,
+                                                    t,
+                                                    t->timeout.abs_value_us);
+  epoll_task_count++;
+  if (GNUNET_YES == t->lifeness)
+    epoll_lifeness_count++;
+  return GNUNET_YES;
+}
+
+
+/**
+ * Remove a task from its epoll entry and the timeout heap.  The
+ * caller must call #epoll_sync_entry() on the entry afterwards.
+ *
+ * @param t task to detach
+ */
+static void
+epoll_detach_task (struct GNUNET_SCHEDULER_Task *t)
+{
+  struct EpollEntry *entry = t->epoll_entry;
+
+  GNUNET_CONTAINER_DLL_remove (entry->head,
+                               entry->tail,
+                               t);
+  t->epoll_entry = NULL;
+  if (NULL != t->timeout_node)
+  {
+    GNUNET_CONTAINER_heap_remove_node (t->timeout_node);
+    t->timeout_node = NULL;
+  }
+  epoll_task_count--;
+  if (GNUNET_YES == t->lifeness)
+    epoll_lifeness_count--;
+}
+
+
+/**
+ * Move a task registered with epoll to the ready queue.
+ *
+ * @param t task to move
+ * @param reason why the task is ready
+ */
+static void
+epoll_queue_ready_task (struct GNUNET_SCHEDULER_Task *t,
+                        enum GNUNET_SCHEDULER_Reason reason)
+{
+  struct EpollEntry *entry = t->epoll_entry;
+
+  epoll_detach_task (t);
+  (void) epoll_sync_entry (entry);
+  t->reason |= reason | GNUNET_SCHEDULER_REASON_PREREQ_DONE;
+  queue_ready_task (t);
+}
+
+
+/**
+ * Wait for events on the file descriptors registered with epoll
+ * and move the tasks that became ready to the ready queue.
+ *
+ * @param rs set to mark the shutdown pipe in if it became readable
+ * @param timeout how long to wait at most
+ * @return number of events, #GNUNET_SYSERR on error
+ */
+static int
+epoll_run (struct GNUNET_NETWORK_FDSet *rs,
+           struct GNUNET_TIME_Relative timeout)
+{
+  struct epoll_event events[EPOLL_MAX_EVENTS];
+  struct EpollEntry *entry;
+  struct GNUNET_SCHEDULER_Task *pos;
+  struct GNUNET_SCHEDULER_Task *next;
+  enum GNUNET_SCHEDULER_Reason reason;
+  int ms;
+  int n;
+  int i;
+
+  if (GNUNET_TIME_UNIT_FOREVER_REL.rel_value_us == timeout.rel_value_us)
+    ms = -1;
+  else if (timeout.rel_value_us / 1000LL >= INT_MAX)
+    ms = INT_MAX;
+  else
+    ms = (int) ((timeout.rel_value_us + 999LL) / 1000LL);
+  n = epoll_wait (epoll_fd,
+                  events,
+                  EPOLL_MAX_EVENTS,
+                  ms);
+  if (n < 0)
+    return GNUNET_SYSERR;
+  for (i = 0; i < n; i++)
+  {
+    entry = events[i].data.ptr;
+    if (NULL == entry)
+    {
+      GNUNET_NETWORK_fdset_set_native (rs,
+                                       epoll_pipe_fd);
+      continue;
+    }
+    next = entry->head;
+    while (NULL != (pos = next))
+    {
+      next = pos->next;
+      reason = 0;
+      if ( (-1 != pos->read_fd) &&
+           (0 != (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) )
+        reason |= GNUNET_SCHEDULER_REASON_READ_READY;
+      if ( (-1 != pos->write_fd) &&
+           (0 != (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) )
+        reason |= GNUNET_SCHEDULER_REASON_WRITE_READY;
+      if (0 == reason)
+        continue;
+      epoll_detach_task (pos);
+      pos->reason |= reason | GNUNET_SCHEDULER_REASON_PREREQ_DONE;
+      queue_ready_task (pos);
+    }
+    (void) epoll_sync_entry (entry);
+  }
+  return n;
+}
+
+
+/**
+ * Move all tasks waiting on the file descriptor of an entry to the
+ * list of pending tasks, marking them as ready due to shutdown.
+ *
+ * @param cls unused
+ * @param key the file descriptor
+ * @param value the `struct EpollEntry`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+epoll_shutdown_entry (void *cls,
+                      uint32_t key,
+                      void *value)
+{
+  struct EpollEntry *entry = value;
+  struct GNUNET_SCHEDULER_Task *pos;
+
+  while (NULL != (pos = entry->head))
+  {
+    epoll_detach_task (pos);
+    pos->reason |= GNUNET_SCHEDULER_REASON_SHUTDOWN;
+    GNUNET_CONTAINER_DLL_insert (pending_head,
+                                 pending_tail,
+                                 pos);
+  }
+  (void) epoll_sync_entry (entry);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Free an entry of #epoll_entries.
+ *
+ * @param cls unused
+ * @param key the file descriptor
+ * @param value the `struct EpollEntry`
+ * @return #GNUNET_OK (continue to iterate)
+ */
+static int
+epoll_free_entry (void *cls,
+                  uint32_t key,
+                  void *value)
+{
+  struct EpollEntry *entry = value;
+
+  GNUNET_break (NULL == entry->head);
+  GNUNET_free (entry);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Create our epoll handle.  If this fails, we fall back to using
+ * select() for all tasks.
+ *
+ * @param pr read end of the shutdown pipe
+ */
+static void
+epoll_init (const struct GNUNET_DISK_FileHandle *pr)
+{
+  struct epoll_event ev;
+
+  epoll_fd = epoll_create1 (EPOLL_CLOEXEC);
+  if (-1 == epoll_fd)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING,
+                  "epoll_create1");
+    return;
+  }
+  GNUNET_DISK_internal_file_handle_ (pr,
+                                     &epoll_pipe_fd,
+                                     sizeof (int));
+  memset (&ev, 0, sizeof (ev));
+  ev.events = EPOLLIN;
+  ev.data.ptr = NULL;
+  if ( (epoll_fd >= FD_SETSIZE) ||
+       (0 != epoll_ctl (epoll_fd,
+                        EPOLL_CTL_ADD,
+                        epoll_pipe_fd,
+                        &ev)) )
+  {
+    GNUNET_break (0);
+    GNUNET_break (0 == close (epoll_fd));
+    epoll_fd = -1;
+    return;
+  }
+  epoll_entries = GNUNET_CONTAINER_multihashmap32_create (16);
+  epoll_timeouts = GNUNET_CONTAINER_heap_create (GNUNET_CONTAINER_HEAP_ORDER_MIN);
+}
+
+
+/**
+ * Release our epoll handle and all associated resources.
+ */
+static void
+epoll_done ()
+{
+  if (-1 == epoll_fd)
+    return;
+  GNUNET_CONTAINER_multihashmap32_iterate (epoll_entries,
+                                           &epoll_free_entry,
+                                           NULL);
+  GNUNET_CONTAINER_multihashmap32_destroy (epoll_entries);
+  epoll_entries = NULL;
+  GNUNET_CONTAINER_heap_destroy (epoll_timeouts);
+  epoll_timeouts = NULL;
+  GNUNET_break (0 == close (epoll_fd));
+  epoll_fd = -1;
+  epoll_pipe_fd = -1;
+}
+#endif
+
+
 /**
  * Check which tasks are ready and move them
  * to the respective ready queue.
@@ -455,6 +1480,15 @@ check_ready (const struct GNUNET_NETWORK_FDSet *rs,
       pending_timeout_last = NULL;
     queue_ready_task (pos);
   }
+  if (0 < wheel_task_count)
+    wheel_advance (now);
+#if USE_EPOLL
+  while ( (NULL != epoll_timeouts) &&
+          (NULL != (pos = GNUNET_CONTAINER_heap_peek (epoll_timeouts))) &&
+          (now.abs_value_us >= pos->timeout.abs_value_us) )
+    epoll_queue_ready_task (pos,
+                            GNUNET_SCHEDULER_REASON_TIMEOUT);
+#endif
   pos = pending_head;
   while (NULL != pos)
   {
@@ -488,6 +1522,13 @@ GNUNET_SCHEDULER_shutdown ()
   struct GNUNET_SCHEDULER_Task *pos;
   int i;
 
+  wheel_shutdown ();
+#if USE_EPOLL
+  if (NULL != epoll_entries)
+    GNUNET_CONTAINER_multihashmap32_iterate (epoll_entries,
+                                             &epoll_shutdown_entry,
+                                             NULL);
+#endif
   for (pos = pending_timeout_head; NULL != pos; pos = pos->next)
     pos->reason |= GNUNET_SCHEDULER_REASON_SHUTDOWN;
   for (pos = pending_head; NULL != pos; pos = pos->next)
@@ -513,7 +1554,7 @@ destroy_task (struct GNUNET_SCHEDULER_Task *t)
 #if EXECINFO
   GNUNET_free (t->backtrace_strings);
 #endif
-  GNUNET_free (t);
+  GNUNET_pool_free (task_pool, t);
 }
 
 
@@ -534,6 +1575,9 @@ run_ready (struct GNUNET_NETWORK_FDSet *rs,
   enum GNUNET_SCHEDULER_Priority p;
   struct GNUNET_SCHEDULER_Task *pos;
   struct GNUNET_SCHEDULER_TaskContext tc;
+  struct GNUNET_TIME_Absolute start;
+  struct GNUNET_TIME_Relative latency;
+  int profiled;
 
   max_priority_added = GNUNET_SCHEDULER_PRIORITY_KEEP;
   do
@@ -584,7 +1628,19 @@ run_ready (struct GNUNET_NETWORK_FDSet *rs,
     LOG (GNUNET_ERROR_TYPE_DEBUG,
 	 "Running task: %p\n",
          pos);
+    profiled = profiling;
+    if (GNUNET_YES == profiled)
+    {
+      start = GNUNET_TIME_absolute_get ();
+      latency = (0 == pos->ready_time.abs_value_us)
+        ? GNUNET_TIME_UNIT_ZERO
+        : GNUNET_TIME_absolute_get_difference (pos->ready_time, start);
+    }
     pos->callback (pos->callback_cls, &tc);
+    if ( (GNUNET_YES == profiled) &&
+         (GNUNET_YES == profiling) )
+      profile_task (pos, p, latency,
+                    GNUNET_TIME_absolute_get_duration (start));
 #if EXECINFO
     unsigned int i;
 
@@ -599,7 +1655,7 @@ run_ready (struct GNUNET_NETWORK_FDSet *rs,
     destroy_task (pos);
     tasks_run++;
   }
-  while ((NULL == pending_head) || (p >= max_priority_added));
+  while ((GNUNET_NO == have_pending_io ()) || (p >= max_priority_added));
 }
 
 
@@ -683,7 +1739,15 @@ check_lifeness ()
   for (t = pending_timeout_head; NULL != t; t = t->next)
     if (t->lifeness == GNUNET_YES)
       return GNUNET_OK;
-  if ((NULL != pending_head) || (NULL != pending_timeout_head))
+  if (0 < wheel_lifeness_count)
+    return GNUNET_OK;
+#if USE_EPOLL
+  if (0 < epoll_lifeness_count)
+    return GNUNET_OK;
+#endif
+  if ( (GNUNET_YES == have_pending_io ()) ||
+       (NULL != pending_timeout_head) ||
+       (0 < wheel_task_count) )
   {
     GNUNET_SCHEDULER_shutdown ();
     return GNUNET_OK;
@@ -692,6 +1756,65 @@ check_lifeness ()
 }
 
 
+/**
+ * Wait until file descriptors become ready or the timeout expires.
+ * Tasks registered with epoll that become ready are moved to the
+ * ready queue directly; readiness of all other file descriptors is
+ * reported in @a rs and @a ws.
+ *
+ * @param rs set of FDs to check for reading (updated)
+ * @param ws set of FDs to check for writing (updated)
+ * @param timeout how long to wait at most
+ * @return number of ready file descriptors, #GNUNET_SYSERR on error
+ */
+static int
+wait_ready (struct GNUNET_NETWORK_FDSet *rs,
+            struct GNUNET_NETWORK_FDSet *ws,
+            struct GNUNET_TIME_Relative timeout)
+{
+  int ret;
+
+#if USE_EPOLL
+  if (-1 != epoll_fd)
+  {
+    if ( (NULL == pending_head) &&
+         (NULL == scheduler_select) )
+    {
+      /* nothing for select(), only report what epoll found */
+      GNUNET_NETWORK_fdset_zero (rs);
+      GNUNET_NETWORK_fdset_zero (ws);
+      return epoll_run (rs,
+                        timeout);
+    }
+    /* the epoll handle is readable if any of its FDs are ready */
+    GNUNET_NETWORK_fdset_set_native (rs,
+                                     epoll_fd);
+  }
+#endif
+  if (NULL == scheduler_select)
+    ret = GNUNET_NETWORK_socket_select (rs,
+                                        ws,
+                                        NULL,
+                                        timeout);
+  else
+    ret = scheduler_select (scheduler_select_cls,
+                            rs,
+                            ws,
+                            NULL,
+                            timeout);
+#if USE_EPOLL
+  if ( (ret > 0) &&
+       (-1 != epoll_fd) &&
+       (GNUNET_YES == GNUNET_NETWORK_fdset_test_native (rs,
+                                                        epoll_fd)) &&
+       (GNUNET_SYSERR == epoll_run (rs,
+                                    GNUNET_TIME_UNIT_ZERO)) )
+    return GNUNET_SYSERR;
+#endif
+  return ret;
+}
+
+
 /**
  * Initialize and run scheduler.  This function will return when all
  * tasks have completed.  On systems with signals, receiving a SIGTERM
@@ -742,6 +1865,9 @@ GNUNET_SCHEDULER_run (GNUNET_SCHEDULER_TaskCallback task,
   pr = GNUNET_DISK_pipe_handle (shutdown_pipe_handle,
                                 GNUNET_DISK_PIPE_END_READ);
   GNUNET_assert (NULL != pr);
+#if USE_EPOLL
+  epoll_init (pr);
+#endif
   my_pid = getpid ();
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Registering signal handlers\n");
@@ -780,17 +1906,9 @@ GNUNET_SCHEDULER_run (GNUNET_SCHEDULER_TaskCallback task,
       /* no blocking, more work already ready! */
       timeout = GNUNET_TIME_UNIT_ZERO;
     }
-    if (NULL == scheduler_select)
-      ret = GNUNET_NETWORK_socket_select (rs,
-                                          ws,
-                                          NULL,
-                                          timeout);
-    else
-      ret = scheduler_select (scheduler_select_cls,
-                              rs,
-                              ws,
-                              NULL,
-                              timeout);
+    ret = wait_ready (rs,
+                      ws,
+                      timeout);
     if (ret == GNUNET_SYSERR)
     {
       if (errno == EINTR)
@@ -893,6 +2011,9 @@ GNUNET_SCHEDULER_run (GNUNET_SCHEDULER_TaskCallback task,
   GNUNET_SIGNAL_handler_uninstall (shc_pipe);
   GNUNET_SIGNAL_handler_uninstall (shc_quit);
   GNUNET_SIGNAL_handler_uninstall (shc_hup);
+#endif
+#if USE_EPOLL
+  epoll_done ();
 #endif
   GNUNET_DISK_pipe_close (shutdown_pipe_handle);
   shutdown_pipe_handle = NULL;
@@ -959,16 +2080,33 @@ GNUNET_SCHEDULER_cancel (struct GNUNET_SCHEDULER_Task *task)
   GNUNET_assert (NULL != active_task);
   if (! task->in_ready_list)
   {
+#if USE_EPOLL
+    if (NULL != task->epoll_entry)
+    {
+      struct EpollEntry *entry = task->epoll_entry;
+
+      epoll_detach_task (task);
+      (void) epoll_sync_entry (entry);
+    }
+    else
+#endif
     if ( (-1 == task->read_fd) &&
          (-1 == task->write_fd) &&
          (NULL == task->read_set) &&
          (NULL == task->write_set) )
     {
-      GNUNET_CONTAINER_DLL_remove (pending_timeout_head,
-                                   pending_timeout_tail,
-                                   task);
-      if (task == pending_timeout_last)
-        pending_timeout_last = NULL;
+      if (0 != task->wheel_pos)
+      {
+        wheel_remove_task (task);
+      }
+      else
+      {
+        GNUNET_CONTAINER_DLL_remove (pending_timeout_head,
+                                     pending_timeout_tail,
+                                     task);
+        if (task == pending_timeout_last)
+          pending_timeout_last = NULL;
+      }
     }
     else
     {
@@ -1019,7 +2157,7 @@ GNUNET_SCHEDULER_add_with_reason_and_priority (GNUNET_SCHEDULER_TaskCallback tas
   GNUNET_assert (NULL != task);
   GNUNET_assert ((NULL != active_task) ||
                  (GNUNET_SCHEDULER_REASON_STARTUP == reason));
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = GNUNET_pool_new (task_pool, struct GNUNET_SCHEDULER_Task);
 #if EXECINFO
   t->num_backtrace_strings = backtrace (backtrace_array, 50);
   t->backtrace_strings =
@@ -1070,7 +2208,7 @@ GNUNET_SCHEDULER_add_delayed_with_priority (struct GNUNET_TIME_Relative delay,
 
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = GNUNET_pool_new (task_pool, struct GNUNET_SCHEDULER_Task);
   t->callback = task;
   t->callback_cls = task_cls;
 #if EXECINFO
@@ -1094,6 +2232,10 @@ GNUNET_SCHEDULER_add_delayed_with_priority (struct GNUNET_TIME_Relative delay,
                                  pending_timeout_tail,
                                  t);
   }
+  else if (GNUNET_YES == use_wheel)
+  {
+    wheel_add_task (t);
+  }
   else
   {
     /* first move from heuristic start backwards to before start time */
@@ -1274,7 +2416,7 @@ add_without_sets (struct GNUNET_TIME_Relative delay,
 
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = GNUNET_pool_new (task_pool, struct GNUNET_SCHEDULER_Task);
   t->callback = task;
   t->callback_cls = task_cls;
 #if EXECINFO
@@ -1333,6 +2475,9 @@ add_without_sets (struct GNUNET_TIME_Relative delay,
   t->timeout = GNUNET_TIME_relative_to_absolute (delay);
   t->priority = check_priority ((priority == GNUNET_SCHEDULER_PRIORITY_KEEP) ? current_priority : priority);
   t->lifeness = current_lifeness;
+#if USE_EPOLL
+  if (GNUNET_YES != epoll_add_task (t))
+#endif
   GNUNET_CONTAINER_DLL_insert (pending_head,
                                pending_tail,
                                t);
@@ -1650,7 +2795,7 @@ GNUNET_SCHEDULER_add_select (enum GNUNET_SCHEDULER_Priority prio,
                                                        task_cls);
   GNUNET_assert (NULL != active_task);
   GNUNET_assert (NULL != task);
-  t = GNUNET_new (struct GNUNET_SCHEDULER_Task);
+  t = GNUNET_pool_new (task_pool, struct GNUNET_SCHEDULER_Task);
   t->callback = task;
   t->callback_cls = task_cls;
 #if EXECINFO
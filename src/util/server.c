@@ -180,6 +180,40 @@ struct GNUNET_SERVER_Handle
    * (we cannot run it in the same task).
    */
   int in_soft_shutdown;
+
+  /**
+   * #GNUNET_YES if clients on UNIX domain sockets may use shared
+   * memory instead of the socket.
+   */
+  int shm_ipc;
+
+  /**
+   * Head of the list of clients that used up their budget
+   * (#GNUNET_SERVER_set_client_budget()) while having more
+   * messages buffered.
+   */
+  struct GNUNET_SERVER_Client *ready_head;
+
+  /**
+   * Tail of the list of clients that used up their budget.
+   */
+  struct GNUNET_SERVER_Client *ready_tail;
+
+  /**
+   * Task processing the clients in the @e ready_head list.
+   */
+  struct GNUNET_SCHEDULER_Task *ready_task;
+
+  /**
+   * Number of clients in the @e ready_head list.
+   */
+  unsigned int ready_count;
+
+  /**
+   * Maximum number of messages we process from a client before
+   * moving on to other clients, 0 for no limit.
+   */
+  unsigned int client_budget;
 };
 
 
@@ -198,6 +232,17 @@ struct GNUNET_SERVER_TransmitHandle
    */
   void *callback_cls;
 
+  /**
+   * Function to call once messages passed to
+   * #GNUNET_SERVER_transmit_messages() were transmitted.
+   */
+  GNUNET_CONNECTION_TransmitContinuation cont;
+
+  /**
+   * Closure for @e cont
+   */
+  void *cont_cls;
+
   /**
    * Active connection transmission handle.
    */
@@ -222,6 +267,18 @@ struct GNUNET_SERVER_Client
    */
   struct GNUNET_SERVER_Client *prev;
 
+  /**
+   * This is a doubly linked list of clients waiting for
+   * their next turn (see `ready_head` of the server).
+   */
+  struct GNUNET_SERVER_Client *next_ready;
+
+  /**
+   * This is a doubly linked list of clients waiting for
+   * their next turn.
+   */
+  struct GNUNET_SERVER_Client *prev_ready;
+
   /**
    * Processing of incoming data.
    */
@@ -290,6 +347,17 @@ struct GNUNET_SERVER_Client
    */
   unsigned int suspended;
 
+  /**
+   * Number of messages we may still process from this client
+   * before others get their turn (if the server has a budget).
+   */
+  unsigned int budget;
+
+  /**
+   * Is this client in the server's `ready_head` list?
+   */
+  int in_ready_list;
+
   /**
    * Last size given when user context was initialized; used for
    * sanity check.
@@ -419,6 +487,8 @@ process_listen_socket (void *cls,
       {
         LOG (GNUNET_ERROR_TYPE_DEBUG,
              "Server accepted incoming connection.\n");
+        if (GNUNET_YES == server->shm_ipc)
+          GNUNET_CONNECTION_shm_probe_ (sock);
         (void) GNUNET_SERVER_connect_socket (server,
                                              sock);
       }
@@ -705,6 +775,39 @@ GNUNET_SERVER_suspend (struct GNUNET_SERVER_Handle *server)
 }
 
 
+/**
+ * Accept offers of shared memory from clients that connect via UNIX
+ * domain sockets (see #GNUNET_CONNECTION_shm_probe_()).  Only for
+ * services whose clients always send the first message.
+ *
+ * @param server server to configure
+ */
+void
+GNUNET_SERVER_enable_shm_ (struct GNUNET_SERVER_Handle *server)
+{
+  server->shm_ipc = GNUNET_YES;
+}
+
+
+/**
+ * Limit the number of messages processed from a client per wakeup.
+ * Once a client used up its budget, the server moves on to the next
+ * client with buffered messages and serves all of them round-robin
+ * from a single task, instead of scheduling a task per client and
+ * #GNUNET_SERVER_receive_done() call.
+ *
+ * @param server server to configure
+ * @param budget maximum number of messages per client and turn,
+ *        0 to process messages without limit (the default)
+ */
+void
+GNUNET_SERVER_set_client_budget (struct GNUNET_SERVER_Handle *server,
+                                 unsigned int budget)
+{
+  server->client_budget = budget;
+}
+
+
 /**
  * Resume accepting connections from the listen socket.
  *
@@ -806,6 +909,11 @@ GNUNET_SERVER_destroy (struct GNUNET_SERVER_Handle *server)
   }
   while (NULL != server->clients_head)
     GNUNET_SERVER_client_disconnect (server->clients_head);
+  if (NULL != server->ready_task)
+  {
+    GNUNET_SCHEDULER_cancel (server->ready_task);
+    server->ready_task = NULL;
+  }
   while (NULL != (hpos = server->handlers))
   {
     server->handlers = hpos->next;
@@ -1030,6 +1138,107 @@ process_incoming (void *cls,
                   int errCode);
 
 
+/**
+ * Start receiving more data from a client.  With our own tokenizer,
+ * the data is read directly into the buffer of the tokenizer.
+ *
+ * @param client the client to receive from
+ * @param timeout how long to wait for data
+ */
+static void
+receive_from_client (struct GNUNET_SERVER_Client *client,
+                     struct GNUNET_TIME_Relative timeout)
+{
+  char *buf;
+  size_t size;
+
+  if ( (NULL != client->server) &&
+       (NULL == client->server->mst_receive) )
+  {
+    buf = GNUNET_SERVER_mst_get_buffer (client->mst,
+                                        &size);
+    GNUNET_CONNECTION_receive_into (client->connection,
+                                    buf,
+                                    GNUNET_MIN (size,
+                                                GNUNET_SERVER_MAX_MESSAGE_SIZE - 1),
+                                    timeout,
+                                    &process_incoming,
+                                    client);
+    return;
+  }
+  GNUNET_CONNECTION_receive (client->connection,
+                             GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
+                             timeout,
+                             &process_incoming,
+                             client);
+}
+
+
+/**
+ * Start a new turn of processing messages from a client.
+ *
+ * @param client the client to process
+ */
+static void
+resume_client (struct GNUNET_SERVER_Client *client);
+
+
+/**
+ * Task run to give the clients that used up their budget their
+ * next turn, in the order in which they ran out.  Clients that
+ * use up their budget again are only served in the next run.
+ *
+ * @param cls the `struct GNUNET_SERVER_Handle`
+ * @param tc scheduler context (unused)
+ */
+static void
+process_ready_clients (void *cls,
+                       const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_SERVER_Handle *server = cls;
+  struct GNUNET_SERVER_Client *client;
+  unsigned int todo;
+
+  server->ready_task = NULL;
+  todo = server->ready_count;
+  while ( (todo-- > 0) &&
+          (NULL != (client = server->ready_head)) )
+  {
+    GNUNET_CONTAINER_MDLL_remove (ready,
+                                  server->ready_head,
+                                  server->ready_tail,
+                                  client);
+    server->ready_count--;
+    client->in_ready_list = GNUNET_NO;
+    resume_client (client);
+  }
+}
+
+
+/**
+ * Queue a client for its next turn in #process_ready_clients().
+ *
+ * @param client client that has more messages to process
+ */
+static void
+schedule_ready (struct GNUNET_SERVER_Client *client)
+{
+  struct GNUNET_SERVER_Handle *server = client->server;
+
+  if (GNUNET_YES == client->in_ready_list)
+    return;
+  client->in_ready_list = GNUNET_YES;
+  GNUNET_CONTAINER_MDLL_insert_tail (ready,
+                                     server->ready_head,
+                                     server->ready_tail,
+                                     client);
+  server->ready_count++;
+  if (NULL == server->ready_task)
+    server->ready_task = GNUNET_SCHEDULER_add_now (&process_ready_clients,
+                                                   server);
+}
+
+
 /**
  * Process messages from the client's message tokenizer until either
  * the tokenizer is empty (and then schedule receiving more), or
@@ -1047,6 +1256,8 @@ static void
 process_mst (struct GNUNET_SERVER_Client *client,
              int ret)
 {
+  int exhausted = GNUNET_NO;
+
   while ((GNUNET_SYSERR != ret) && (NULL != client->server) &&
          (GNUNET_YES != client->shutdown_now) && (0 == client->suspended))
   {
@@ -1056,13 +1267,19 @@ process_mst (struct GNUNET_SERVER_Client *client,
            "Server re-enters receive loop, timeout: %s.\n",
            GNUNET_STRINGS_relative_time_to_string (client->idle_timeout, GNUNET_YES));
       client->receive_pending = GNUNET_YES;
-      GNUNET_CONNECTION_receive (client->connection,
-                                 GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
-                                 client->idle_timeout,
-                                 &process_incoming,
-                                 client);
+      receive_from_client (client,
+                         client->idle_timeout);
       break;
     }
+    if (0 != client->server->client_budget)
+    {
+      if (0 == client->budget)
+      {
+        exhausted = GNUNET_YES;
+        break;
+      }
+      client->budget--;
+    }
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Server processes additional messages instantly.\n");
     if (NULL != client->server->mst_receive)
@@ -1084,6 +1301,12 @@ process_mst (struct GNUNET_SERVER_Client *client,
     LOG (GNUNET_ERROR_TYPE_DEBUG,
          "Server has more data pending but is suspended.\n");
     client->receive_pending = GNUNET_SYSERR;    /* data pending */
+    if (GNUNET_YES == exhausted)
+    {
+      LOG (GNUNET_ERROR_TYPE_DEBUG,
+           "Client used up its budget, serving others first.\n");
+      schedule_ready (client);
+    }
   }
   if ( (GNUNET_SYSERR == ret) ||
        (GNUNET_YES == client->shutdown_now) )
@@ -1135,11 +1358,8 @@ process_incoming (void *cls,
          "Receive time out, but no disconnect due to sending (%p)\n",
          client);
     client->receive_pending = GNUNET_YES;
-    GNUNET_CONNECTION_receive (client->connection,
-                               GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
-                               GNUNET_TIME_absolute_get_remaining (end),
-                               &process_incoming,
-                               client);
+    receive_from_client (client,
+                         GNUNET_TIME_absolute_get_remaining (end));
     return;
   }
   if ( (NULL == buf) ||
@@ -1162,6 +1382,10 @@ process_incoming (void *cls,
        GNUNET_a2s (addr, addrlen));
   GNUNET_SERVER_client_keep (client);
   client->last_activity = now;
+  /* the message we are about to process counts against the budget */
+  client->budget = server->client_budget;
+  if (client->budget > 0)
+    client->budget--;
 
   if (NULL != server->mst_receive)
   {
@@ -1175,13 +1399,13 @@ process_incoming (void *cls,
   }
   else if (NULL != client->mst)
   {
+    /* receive_from_client() made us read into the tokenizer's buffer */
     ret =
-        GNUNET_SERVER_mst_receive (client->mst,
-                                   client,
-                                   buf,
-                                   available,
-                                   GNUNET_NO,
-                                   GNUNET_YES);
+        GNUNET_SERVER_mst_receive_buffer (client->mst,
+                                          client,
+                                          available,
+                                          GNUNET_NO,
+                                          GNUNET_YES);
   }
   else
   {
@@ -1207,17 +1431,29 @@ restart_processing (void *cls,
 {
   struct GNUNET_SERVER_Client *client = cls;
 
-  GNUNET_assert (GNUNET_YES != client->shutdown_now);
   client->restart_task = NULL;
+  resume_client (client);
+}
+
+
+/**
+ * Start a new turn of processing messages from a client: either
+ * continue with the messages that are still in the buffer or
+ * read again from the network.
+ *
+ * @param client the client to process
+ */
+static void
+resume_client (struct GNUNET_SERVER_Client *client)
+{
+  GNUNET_assert (GNUNET_YES != client->shutdown_now);
+  client->budget = client->server->client_budget;
   if (GNUNET_NO == client->receive_pending)
   {
     LOG (GNUNET_ERROR_TYPE_DEBUG, "Server begins to read again from client.\n");
     client->receive_pending = GNUNET_YES;
-    GNUNET_CONNECTION_receive (client->connection,
-                               GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
-                               client->idle_timeout,
-                               &process_incoming,
-                               client);
+    receive_from_client (client,
+                         client->idle_timeout);
     return;
   }
   LOG (GNUNET_ERROR_TYPE_DEBUG,
@@ -1301,11 +1537,8 @@ GNUNET_SERVER_connect_socket (struct GNUNET_SERVER_Handle *server,
   for (n = server->connect_notify_list_head; NULL != n; n = n->next)
     n->callback (n->callback_cls, client);
   client->receive_pending = GNUNET_YES;
-  GNUNET_CONNECTION_receive (client->connection,
-                             GNUNET_SERVER_MAX_MESSAGE_SIZE - 1,
-                             client->idle_timeout,
-                             &process_incoming,
-                             client);
+  receive_from_client (client,
+                       client->idle_timeout);
   return client;
 }
 
@@ -1530,6 +1763,15 @@ GNUNET_SERVER_client_disconnect (struct GNUNET_SERVER_Client *client)
     GNUNET_SCHEDULER_cancel (client->restart_task);
     client->restart_task = NULL;
   }
+  if (GNUNET_YES == client->in_ready_list)
+  {
+    GNUNET_CONTAINER_MDLL_remove (ready,
+                                  server->ready_head,
+                                  server->ready_tail,
+                                  client);
+    server->ready_count--;
+    client->in_ready_list = GNUNET_NO;
+  }
   if (NULL != client->warn_task)
   {
     GNUNET_SCHEDULER_cancel (client->warn_task);
@@ -1617,6 +1859,24 @@ GNUNET_SERVER_client_disable_corking (struct GNUNET_SERVER_Client *client)
 }
 
 
+/**
+ * Limit the amount of data that the kernel buffers for the given
+ * client beyond what it could already send, so that queued data
+ * stays with the application as long as possible.
+ *
+ * @param client handle to the client
+ * @param bytes maximum number of not-yet-sent bytes in the kernel
+ * @return #GNUNET_OK on success
+ */
+int
+GNUNET_SERVER_client_set_notsent_lowat (struct GNUNET_SERVER_Client *client,
+                                        uint32_t bytes)
+{
+  return GNUNET_CONNECTION_set_notsent_lowat (client->connection,
+                                              bytes);
+}
+
+
 /**
  * Wrapper for transmission notification that calls the original
  * callback and update the last activity time for our connection.
@@ -1662,7 +1922,8 @@ GNUNET_SERVER_notify_transmit_ready (struct GNUNET_SERVER_Client *client,
                                      GNUNET_CONNECTION_TransmitReadyNotify callback,
                                      void *callback_cls)
 {
-  if (NULL != client->th.callback)
+  if ( (NULL != client->th.callback) ||
+       (NULL != client->th.cont) )
     return NULL;
   client->th.callback_cls = callback_cls;
   client->th.callback = callback;
@@ -1685,6 +1946,69 @@ GNUNET_SERVER_notify_transmit_ready_cancel (struct GNUNET_SERVER_TransmitHandle
   GNUNET_CONNECTION_notify_transmit_ready_cancel (th->cth);
   th->cth = NULL;
   th->callback = NULL;
+  th->cont = NULL;
+}
+
+
+/**
+ * Wrapper for the continuation of #GNUNET_SERVER_transmit_messages()
+ * that calls the original continuation and updates the last activity
+ * time for our connection.
+ *
+ * @param cls the `struct GNUNET_SERVER_Client *`
+ * @param result #GNUNET_OK if the messages were transmitted
+ */
+static void
+transmit_messages_cont_wrapper (void *cls,
+                                int result)
+{
+  struct GNUNET_SERVER_Client *client = cls;
+  GNUNET_CONNECTION_TransmitContinuation cont;
+
+  client->th.cth = NULL;
+  cont = client->th.cont;
+  client->th.cont = NULL;
+  client->last_activity = GNUNET_TIME_absolute_get ();
+  cont (client->th.cont_cls, result);
+}
+
+
+/**
+ * Transmit messages to a client without copying them.  The messages
+ * must remain valid until @a cont is called or the request is
+ * cancelled using #GNUNET_SERVER_notify_transmit_ready_cancel.
+ *
+ * @param client client to transmit messages to
+ * @param msgs messages to send
+ * @param count number of messages in @a msgs, at most
+ *        #GNUNET_CONNECTION_MAX_MESSAGES
+ * @param timeout after how long should we give up (and call
+ *        @a cont with #GNUNET_SYSERR)?
+ * @param cont function to call once the messages were transmitted
+ * @param cont_cls closure for @a cont
+ * @return non-NULL if the transmission was queued,
+ *         NULL if we are already going to notify someone else (busy)
+ */
+struct GNUNET_SERVER_TransmitHandle *
+GNUNET_SERVER_transmit_messages (struct GNUNET_SERVER_Client *client,
+                                 const struct GNUNET_MessageHeader *const *msgs,
+                                 unsigned int count,
+                                 struct GNUNET_TIME_Relative timeout,
+                                 GNUNET_CONNECTION_TransmitContinuation cont,
+                                 void *cont_cls)
+{
+  if ( (NULL != client->th.callback) ||
+       (NULL != client->th.cont) )
+    return NULL;
+  client->th.cont = cont;
+  client->th.cont_cls = cont_cls;
+  client->th.cth = GNUNET_CONNECTION_transmit_messages (client->connection,
+                                                        msgs,
+                                                        count,
+                                                        timeout,
+                                                        &transmit_messages_cont_wrapper,
+                                                        client);
+  return &client->th;
 }
 
 
@@ -1755,6 +2079,12 @@ GNUNET_SERVER_receive_done (struct GNUNET_SERVER_Client *client,
   }
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "GNUNET_SERVER_receive_done causes restart in reading from the socket\n");
+  if (0 != client->server->client_budget)
+  {
+    /* share one task with the other clients waiting for their turn */
+    schedule_ready (client);
+    return;
+  }
   GNUNET_assert (NULL == client->restart_task);
   client->restart_task = GNUNET_SCHEDULER_add_now (&restart_processing,
                                                    client);
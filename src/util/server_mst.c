@@ -36,6 +36,13 @@
 
 #define LOG(kind,...) GNUNET_log_from (kind, "util", __VA_ARGS__)
 
+/**
+ * Size of the buffer of a tokenizer that is used with
+ * #GNUNET_SERVER_mst_get_buffer(), so that we can read
+ * a full message with one call.
+ */
+#define INPLACE_BUFFER_SIZE GNUNET_SERVER_MAX_MESSAGE_SIZE
+
 
 /**
  * Handle to a message stream tokenizer.
@@ -73,6 +80,17 @@ struct GNUNET_SERVER_MessageStreamTokenizer
    */
   struct GNUNET_MessageHeader *hdr;
 
+  /**
+   * Buffer we copy complete messages to that are not properly
+   * aligned in @e hdr, NULL if we did not need it yet.
+   */
+  struct GNUNET_MessageHeader *align_buf;
+
+  /**
+   * Size of @e align_buf.
+   */
+  size_t align_size;
+
 };
 
 
@@ -121,6 +139,7 @@ GNUNET_SERVER_mst_receive (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
                            int purge, int one_shot)
 {
   const struct GNUNET_MessageHeader *hdr;
+  struct GNUNET_MessageHeader hbuf;
   size_t delta;
   uint16_t want;
   char *ibuf;
@@ -139,10 +158,9 @@ GNUNET_SERVER_mst_receive (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
   {
 do_align:
     GNUNET_assert (mst->pos >= mst->off);
-    if ((mst->curr_buf - mst->off < sizeof (struct GNUNET_MessageHeader)) ||
-        (0 != (mst->off % ALIGN_FACTOR)))
+    if (mst->curr_buf - mst->off < sizeof (struct GNUNET_MessageHeader))
     {
-      /* need to align or need more space */
+      /* need more space */
       mst->pos -= mst->off;
       memmove (ibuf, &ibuf[mst->off], mst->pos);
       mst->off = 0;
@@ -166,8 +184,11 @@ do_align:
       }
       return GNUNET_OK;
     }
-    hdr = (const struct GNUNET_MessageHeader *) &ibuf[mst->off];
-    want = ntohs (hdr->size);
+    /* the header may not be aligned, so copy it out */
+    memcpy (&hbuf,
+            &ibuf[mst->off],
+            sizeof (struct GNUNET_MessageHeader));
+    want = ntohs (hbuf.size);
     if (want < sizeof (struct GNUNET_MessageHeader))
     {
       GNUNET_break_op (0);
@@ -217,6 +238,19 @@ do_align:
     }
     if (one_shot == GNUNET_YES)
       one_shot = GNUNET_SYSERR;
+    if (0 != (mst->off % ALIGN_FACTOR))
+    {
+      /* copy just this message to align it, leaving the
+         rest of the buffer where it is */
+      if (mst->align_size < want)
+      {
+        GNUNET_free_non_null (mst->align_buf);
+        mst->align_buf = GNUNET_malloc (want);
+        mst->align_size = want;
+      }
+      memcpy (mst->align_buf, hdr, want);
+      hdr = mst->align_buf;
+    }
     mst->off += want;
     if (GNUNET_SYSERR == mst->cb (mst->cb_cls, client_identity, hdr))
       return GNUNET_SYSERR;
@@ -296,6 +330,98 @@ copy:
 }
 
 
+/**
+ * Obtain the free space at the end of the receive buffer of the
+ * tokenizer, so that the caller can read data into it directly
+ * and then pass it to #GNUNET_SERVER_mst_receive_buffer().  This
+ * avoids copying the data for all messages that arrive complete;
+ * only the partial message at the end of the buffer is moved to
+ * make room for more data.
+ *
+ * @param mst tokenizer to use
+ * @param[out] size set to the number of bytes available in the buffer
+ * @return where to write the data to
+ */
+char *
+GNUNET_SERVER_mst_get_buffer (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
+                              size_t *size)
+{
+  struct GNUNET_MessageHeader hbuf;
+  size_t need;
+  char *ibuf;
+
+  GNUNET_assert (mst->off <= mst->pos);
+  ibuf = (char *) mst->hdr;
+  if (mst->off == mst->pos)
+  {
+    mst->off = 0;
+    mst->pos = 0;
+  }
+  /* make sure we have room for at least the rest of a partial message */
+  need = sizeof (struct GNUNET_MessageHeader);
+  if (mst->pos - mst->off >= sizeof (struct GNUNET_MessageHeader))
+  {
+    memcpy (&hbuf,
+            &ibuf[mst->off],
+            sizeof (struct GNUNET_MessageHeader));
+    if (ntohs (hbuf.size) > mst->pos - mst->off)
+      need = ntohs (hbuf.size) - (mst->pos - mst->off);
+  }
+  if ( (mst->curr_buf - mst->pos < need) &&
+       (mst->off > 0) )
+  {
+    /* partial message at the end, move it to the front */
+    mst->pos -= mst->off;
+    memmove (ibuf, &ibuf[mst->off], mst->pos);
+    mst->off = 0;
+  }
+  if (mst->curr_buf < GNUNET_MAX (mst->pos + need,
+                                  INPLACE_BUFFER_SIZE))
+  {
+    mst->curr_buf = GNUNET_MAX (mst->pos + need,
+                                INPLACE_BUFFER_SIZE);
+    mst->hdr = GNUNET_realloc (mst->hdr, mst->curr_buf);
+    ibuf = (char *) mst->hdr;
+  }
+  *size = mst->curr_buf - mst->pos;
+  return &ibuf[mst->pos];
+}
+
+
+/**
+ * Process data that was written into the buffer returned by
+ * #GNUNET_SERVER_mst_get_buffer() and call the callback for all
+ * complete messages, which are passed without copying them unless
+ * they are not properly aligned.
+ *
+ * @param mst tokenizer to use
+ * @param client_identity ID of client for which this is a buffer
+ * @param size number of bytes that were written to the buffer
+ * @param purge should any excess bytes in the buffer be discarded
+ *       (i.e. for packet-based services like UDP)
+ * @param one_shot only call callback once, keep rest of message in buffer
+ * @return #GNUNET_OK if we are done processing (need more data)
+ *         #GNUNET_NO if @a one_shot was set and we have another message ready
+ *         #GNUNET_SYSERR if the data stream is corrupt
+ */
+int
+GNUNET_SERVER_mst_receive_buffer (struct GNUNET_SERVER_MessageStreamTokenizer *mst,
+                                  void *client_identity,
+                                  size_t size,
+                                  int purge,
+                                  int one_shot)
+{
+  GNUNET_assert (mst->pos + size <= mst->curr_buf);
+  mst->pos += size;
+  return GNUNET_SERVER_mst_receive (mst,
+                                    client_identity,
+                                    NULL,
+                                    0,
+                                    purge,
+                                    one_shot);
+}
+
+
 /**
  * Destroys a tokenizer.
  *
@@ -304,6 +430,7 @@ copy:
 void
 GNUNET_SERVER_mst_destroy (struct GNUNET_SERVER_MessageStreamTokenizer *mst)
 {
+  GNUNET_free_non_null (mst->align_buf);
   GNUNET_free (mst->hdr);
   GNUNET_free (mst);
 }
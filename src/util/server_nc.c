@@ -31,6 +31,22 @@
 #define LOG(kind,...) GNUNET_log_from (kind, "util-server-nc", __VA_ARGS__)
 
 
+/**
+ * Reference-counted message that can be queued for several
+ * clients without copying it for each of them.
+ */
+struct GNUNET_SERVER_SharedMessage
+{
+
+  /**
+   * Number of references (queue entries plus the creator's).
+   */
+  unsigned int rc;
+
+  /* followed by the message */
+};
+
+
 /**
  * Entry in list of messages pending to be transmitted.
  */
@@ -49,10 +65,16 @@ struct PendingMessageList
 
   /**
    * Message to transmit (allocated at the end of this
-   * struct, do not free)
+   * struct or in @e shared, do not free)
    */
   const struct GNUNET_MessageHeader *msg;
 
+  /**
+   * Shared buffer holding @e msg, NULL if @e msg is allocated
+   * at the end of this struct.
+   */
+  struct GNUNET_SERVER_SharedMessage *shared;
+
   /**
    * Can this message be dropped?
    */
@@ -144,6 +166,70 @@ struct GNUNET_SERVER_NotificationContext
 };
 
 
+/**
+ * Create a shared message of the given size.  The caller must
+ * fill in the message (including its header) via
+ * #GNUNET_SERVER_shared_message_get() before queueing it, and
+ * must drop its reference with #GNUNET_SERVER_shared_message_drop()
+ * when done.
+ *
+ * @param size total size of the message in bytes
+ * @return the shared message, with a reference count of one
+ */
+struct GNUNET_SERVER_SharedMessage *
+GNUNET_SERVER_shared_message_create (uint16_t size)
+{
+  struct GNUNET_SERVER_SharedMessage *sm;
+
+  GNUNET_assert (size >= sizeof (struct GNUNET_MessageHeader));
+  sm = GNUNET_malloc (sizeof (struct GNUNET_SERVER_SharedMessage) + size);
+  sm->rc = 1;
+  return sm;
+}
+
+
+/**
+ * Obtain the message held by a shared message.
+ *
+ * @param sm the shared message
+ * @return the message buffer
+ */
+struct GNUNET_MessageHeader *
+GNUNET_SERVER_shared_message_get (struct GNUNET_SERVER_SharedMessage *sm)
+{
+  return (struct GNUNET_MessageHeader *) &sm[1];
+}
+
+
+/**
+ * Drop a reference to a shared message, freeing it once the
+ * last queue holding it has transmitted (or discarded) it.
+ *
+ * @param sm the shared message
+ */
+void
+GNUNET_SERVER_shared_message_drop (struct GNUNET_SERVER_SharedMessage *sm)
+{
+  GNUNET_assert (sm->rc > 0);
+  if (0 == --sm->rc)
+    GNUNET_free (sm);
+}
+
+
+/**
+ * Free an entry of a client's pending message queue.
+ *
+ * @param pml entry to free
+ */
+static void
+free_pending (struct PendingMessageList *pml)
+{
+  if (NULL != pml->shared)
+    GNUNET_SERVER_shared_message_drop (pml->shared);
+  GNUNET_free (pml);
+}
+
+
 /**
  * Client has disconnected, clean up.
  *
@@ -179,7 +265,7 @@ handle_client_disconnect (void *cls,
     GNUNET_CONTAINER_DLL_remove (pos->pending_head,
                                  pos->pending_tail,
                                  pml);
-    GNUNET_free (pml);
+    free_pending (pml);
     pos->num_pending--;
   }
   if (NULL != pos->th)
@@ -245,7 +331,7 @@ GNUNET_SERVER_notification_context_destroy (struct GNUNET_SERVER_NotificationCon
       GNUNET_CONTAINER_DLL_remove (pos->pending_head,
                                    pos->pending_tail,
                                    pml);
-      GNUNET_free (pml);
+      free_pending (pml);
       pos->num_pending--;
     }
     GNUNET_assert (0 == pos->num_pending);
@@ -329,7 +415,7 @@ transmit_message (void *cls,
     memcpy (&cbuf[ret], pml->msg, msize);
     ret += msize;
     size -= msize;
-    GNUNET_free (pml);
+    free_pending (pml);
     cl->num_pending--;
   }
   if (NULL != pml)
@@ -357,12 +443,14 @@ transmit_message (void *cls,
  * @param nc context to modify
  * @param client client to transmit to
  * @param msg message to send
+ * @param shared shared message holding @a msg, NULL to queue a copy
  * @param can_drop can this message be dropped due to queue length limitations
  */
 static void
 do_unicast (struct GNUNET_SERVER_NotificationContext *nc,
             struct ClientList *client,
             const struct GNUNET_MessageHeader *msg,
+            struct GNUNET_SERVER_SharedMessage *shared,
             int can_drop)
 {
   struct PendingMessageList *pml;
@@ -382,16 +470,26 @@ do_unicast (struct GNUNET_SERVER_NotificationContext *nc,
      * queue that are 'droppable' */
   }
   client->num_pending++;
-  size = ntohs (msg->size);
-  pml = GNUNET_malloc (sizeof (struct PendingMessageList) + size);
-  pml->msg = (const struct GNUNET_MessageHeader *) &pml[1];
+  if (NULL != shared)
+  {
+    pml = GNUNET_new (struct PendingMessageList);
+    pml->msg = msg;
+    pml->shared = shared;
+    shared->rc++;
+  }
+  else
+  {
+    size = ntohs (msg->size);
+    pml = GNUNET_malloc (sizeof (struct PendingMessageList) + size);
+    pml->msg = (const struct GNUNET_MessageHeader *) &pml[1];
+    memcpy (&pml[1], msg, size);
+  }
   pml->can_drop = can_drop;
   LOG (GNUNET_ERROR_TYPE_DEBUG,
        "Adding message of type %u and size %u to pending queue (which has %u entries)\n",
        ntohs (msg->type),
        ntohs (msg->size),
        (unsigned int) nc->queue_length);
-  memcpy (&pml[1], msg, size);
   /* append */
   GNUNET_CONTAINER_DLL_insert_tail (client->pending_head,
                                     client->pending_tail,
@@ -427,7 +525,33 @@ GNUNET_SERVER_notification_context_unicast (struct GNUNET_SERVER_NotificationCon
     if (pos->client == client)
       break;
   GNUNET_assert (NULL != pos);
-  do_unicast (nc, pos, msg, can_drop);
+  do_unicast (nc, pos, msg, NULL, can_drop);
+}
+
+
+/**
+ * Queue a shared message for a particular client without copying
+ * it; the client must have already been added to the notification
+ * context.  The caller keeps its own reference to @a sm.
+ *
+ * @param nc context to modify
+ * @param client client to transmit to
+ * @param sm message to send
+ * @param can_drop can this message be dropped due to queue length limitations
+ */
+void
+GNUNET_SERVER_notification_context_unicast_shared (struct GNUNET_SERVER_NotificationContext *nc,
+                                                   struct GNUNET_SERVER_Client *client,
+                                                   struct GNUNET_SERVER_SharedMessage *sm,
+                                                   int can_drop)
+{
+  struct ClientList *pos;
+
+  for (pos = nc->clients_head; NULL != pos; pos = pos->next)
+    if (pos->client == client)
+      break;
+  GNUNET_assert (NULL != pos);
+  do_unicast (nc, pos, GNUNET_SERVER_shared_message_get (sm), sm, can_drop);
 }
 
 
@@ -444,10 +568,24 @@ GNUNET_SERVER_notification_context_broadcast (struct
                                               const struct GNUNET_MessageHeader *msg,
                                               int can_drop)
 {
+  struct GNUNET_SERVER_SharedMessage *sm;
+  struct GNUNET_MessageHeader *copy;
   struct ClientList *pos;
 
+  if ( (NULL == nc->clients_head) ||
+       (nc->clients_head == nc->clients_tail) )
+  {
+    /* zero or one client, a private copy is cheaper */
+    for (pos = nc->clients_head; NULL != pos; pos = pos->next)
+      do_unicast (nc, pos, msg, NULL, can_drop);
+    return;
+  }
+  sm = GNUNET_SERVER_shared_message_create (ntohs (msg->size));
+  copy = GNUNET_SERVER_shared_message_get (sm);
+  memcpy (copy, msg, ntohs (msg->size));
   for (pos = nc->clients_head; NULL != pos; pos = pos->next)
-    do_unicast (nc, pos, msg, can_drop);
+    do_unicast (nc, pos, copy, sm, can_drop);
+  GNUNET_SERVER_shared_message_drop (sm);
 }
 
 
@@ -110,6 +110,17 @@ NEXT:
 /* ****************** service struct ****************** */
 
 
+/**
+ * How often does the main process check on its worker processes?
+ */
+#define WORKER_CHECK_FREQUENCY GNUNET_TIME_UNIT_SECONDS
+
+/**
+ * Maximum number of worker processes of a service.
+ */
+#define MAX_WORKERS 64
+
+
 /**
  * Context for "service_task".
  */
@@ -228,11 +239,52 @@ struct GNUNET_SERVICE_Context
    */
   int match_gid;
 
+  /**
+   * Do we let clients on UNIX domain sockets exchange data with us
+   * through shared memory (option SHM_IPC)?
+   */
+  int shm_ipc;
+
+  /**
+   * Maximum number of messages to process from a client before
+   * serving others (option CLIENT_BUDGET), 0 for no limit.
+   */
+  unsigned int client_budget;
+
   /**
    * Our options.
    */
   enum GNUNET_SERVICE_Options options;
 
+  /**
+   * Process IDs of the worker processes we forked; only set in the
+   * main process.
+   */
+  pid_t *workers;
+
+  /**
+   * Number of entries in @e workers.
+   */
+  unsigned int num_workers;
+
+  /**
+   * Pipe between the main process and its workers.  The main process
+   * holds the write end; the workers watch the read end to notice
+   * when the main process is gone.  NULL if we run as a single process.
+   */
+  struct GNUNET_DISK_PipeHandle *worker_pipe;
+
+  /**
+   * Task checking on the workers (main process) or watching the main
+   * process (workers).
+   */
+  struct GNUNET_SCHEDULER_Task *worker_task;
+
+  /**
+   * #GNUNET_YES if we are a worker process.
+   */
+  int is_worker;
+
 };
 
 
@@ -935,6 +987,8 @@ receive_sockets_from_parent (struct GNUNET_SERVICE_Context *sctx)
  * - ACCEPT_FROM6 (only allow connections from specified IPv6 subnets)
  * - REJECT_FROM  (disallow allow connections from specified IPv4 subnets)
  * - REJECT_FROM6 (disallow allow connections from specified IPv6 subnets)
+ * - SHM_IPC (let local clients use shared memory instead of the socket)
+ * - CLIENT_BUDGET (messages processed per client before serving others)
  *
  * @param sctx service context to initialize
  * @return #GNUNET_OK if configuration succeeded
@@ -943,6 +997,7 @@ static int
 setup_service (struct GNUNET_SERVICE_Context *sctx)
 {
   struct GNUNET_TIME_Relative idleout;
+  unsigned long long budget;
   int tolerant;
 
 #ifndef MINGW
@@ -1037,6 +1092,23 @@ setup_service (struct GNUNET_SERVICE_Context *sctx)
   process_acl4 (&sctx->v4_allowed, sctx, "ACCEPT_FROM");
   process_acl6 (&sctx->v6_denied, sctx, "REJECT_FROM6");
   process_acl6 (&sctx->v6_allowed, sctx, "ACCEPT_FROM6");
+  sctx->shm_ipc =
+      GNUNET_CONFIGURATION_get_value_yesno (sctx->cfg, sctx->service_name,
+                                            "SHM_IPC");
+  if (GNUNET_CONFIGURATION_have_value
+      (sctx->cfg, sctx->service_name, "CLIENT_BUDGET"))
+  {
+    if (GNUNET_OK !=
+        GNUNET_CONFIGURATION_get_value_number (sctx->cfg, sctx->service_name,
+                                               "CLIENT_BUDGET", &budget))
+    {
+      LOG (GNUNET_ERROR_TYPE_ERROR,
+           _("Specified value for `%s' of service `%s' is invalid\n"),
+           "CLIENT_BUDGET", sctx->service_name);
+      return GNUNET_SYSERR;
+    }
+    sctx->client_budget = (unsigned int) budget;
+  }
 
   return GNUNET_OK;
 }
@@ -1143,6 +1215,214 @@ shutdown_task (void *cls,
 }
 
 
+#ifndef WINDOWS
+/**
+ * Task run in the main process to check that all workers are still
+ * alive.  If one of them died, we terminate with an error, so that ARM
+ * restarts the whole pool.
+ *
+ * @param cls the `struct GNUNET_SERVICE_Context`
+ * @param tc scheduler context
+ */
+static void
+check_workers (void *cls,
+               const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_SERVICE_Context *sctx = cls;
+  unsigned int i;
+  int status;
+
+  sctx->worker_task = NULL;
+  if (0 != (GNUNET_SCHEDULER_REASON_SHUTDOWN & tc->reason))
+    return;
+  for (i = 0; i < sctx->num_workers; i++)
+  {
+    if (sctx->workers[i] != waitpid (sctx->workers[i], &status, WNOHANG))
+      continue;
+    LOG (GNUNET_ERROR_TYPE_ERROR,
+         _("Worker process %u of service `%s' terminated, shutting down\n"),
+         (unsigned int) sctx->workers[i],
+         sctx->service_name);
+    sctx->workers[i] = 0;
+    sctx->ret = GNUNET_SYSERR;
+    GNUNET_SCHEDULER_shutdown ();
+    return;
+  }
+  sctx->worker_task = GNUNET_SCHEDULER_add_delayed (WORKER_CHECK_FREQUENCY,
+                                                    &check_workers, sctx);
+}
+
+
+/**
+ * Task run in a worker process when the main process is gone (the
+ * worker pipe was closed).
+ *
+ * @param cls the `struct GNUNET_SERVICE_Context`
+ * @param tc scheduler context
+ */
+static void
+main_process_gone (void *cls,
+                   const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_SERVICE_Context *sctx = cls;
+
+  sctx->worker_task = NULL;
+  if (0 != (GNUNET_SCHEDULER_REASON_SHUTDOWN & tc->reason))
+    return;
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Main process of service `%s' is gone, shutting down worker\n",
+       sctx->service_name);
+  GNUNET_SCHEDULER_shutdown ();
+}
+
+
+/**
+ * Close the control pipe from ARM in a worker process; only the main
+ * process must receive the signals ARM sends through it.
+ */
+static void
+close_control_pipe ()
+{
+  const char *env;
+  char *end;
+  unsigned long fd;
+
+  /* see os_priority.c */
+  env = getenv ("GNUNET_OS_CONTROL_PIPE");
+  if ((NULL == env) || ('\0' == env[0]))
+    return;
+  errno = 0;
+  fd = strtoul (env, &end, 16);
+  if ((0 == errno) && (env != end))
+    (void) CLOSE ((int) fd);
+  unsetenv ("GNUNET_OS_CONTROL_PIPE");
+}
+
+
+/**
+ * Fork the worker processes of a stateless service if the WORKERS
+ * option asks for more than one process.  All processes (including
+ * the main process, which remains the one ARM supervises) accept
+ * connections on the listen sockets we got from ARM.
+ *
+ * @param sctx service context
+ * @return #GNUNET_OK on success (in the main process and in each
+ *         worker), #GNUNET_SYSERR on error
+ */
+static int
+start_workers (struct GNUNET_SERVICE_Context *sctx)
+{
+  unsigned long long num;
+  unsigned int i;
+  pid_t pid;
+
+  if ((GNUNET_OK !=
+       GNUNET_CONFIGURATION_get_value_number (sctx->cfg, sctx->service_name,
+                                              "WORKERS", &num)) ||
+      (num <= 1))
+    return GNUNET_OK;
+  if (0 == (sctx->options & GNUNET_SERVICE_OPTION_STATELESS))
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Service `%s' cannot run multiple processes, ignoring `%s'\n"),
+         sctx->service_name, "WORKERS");
+    return GNUNET_OK;
+  }
+  if (NULL == sctx->lsocks)
+  {
+    LOG (GNUNET_ERROR_TYPE_WARNING,
+         _("Service `%s' needs listen sockets from ARM to run multiple processes, ignoring `%s'\n"),
+         sctx->service_name, "WORKERS");
+    return GNUNET_OK;
+  }
+  if (num > MAX_WORKERS)
+  {
+    GNUNET_log_config_invalid (GNUNET_ERROR_TYPE_WARNING,
+                               sctx->service_name, "WORKERS",
+                               _("too many worker processes"));
+    num = MAX_WORKERS;
+  }
+  /* losing the race for a connection must not block a worker */
+  for (i = 0; NULL != sctx->lsocks[i]; i++)
+    GNUNET_break (GNUNET_OK ==
+                  GNUNET_NETWORK_socket_set_blocking (sctx->lsocks[i],
+                                                      GNUNET_NO));
+  sctx->worker_pipe = GNUNET_DISK_pipe (GNUNET_NO, GNUNET_NO,
+                                        GNUNET_NO, GNUNET_NO);
+  if (NULL == sctx->worker_pipe)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_ERROR, "pipe");
+    return GNUNET_SYSERR;
+  }
+  for (i = 1; i < num; i++)
+  {
+    pid = fork ();
+    if (-1 == pid)
+    {
+      LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "fork");
+      break;
+    }
+    if (0 == pid)
+    {
+      /* worker process */
+      GNUNET_free_non_null (sctx->workers);
+      sctx->workers = NULL;
+      sctx->num_workers = 0;
+      sctx->is_worker = GNUNET_YES;
+      if (-1 != sctx->ready_confirm_fd)
+      {
+        GNUNET_break (0 == CLOSE (sctx->ready_confirm_fd));
+        sctx->ready_confirm_fd = -1;
+      }
+      GNUNET_break (GNUNET_OK ==
+                    GNUNET_DISK_pipe_close_end (sctx->worker_pipe,
+                                                GNUNET_DISK_PIPE_END_WRITE));
+      close_control_pipe ();
+      GNUNET_CRYPTO_seed_weak_random ((int32_t) getpid ());
+      return GNUNET_OK;
+    }
+    GNUNET_array_append (sctx->workers, sctx->num_workers, pid);
+  }
+  GNUNET_break (GNUNET_OK ==
+                GNUNET_DISK_pipe_close_end (sctx->worker_pipe,
+                                            GNUNET_DISK_PIPE_END_READ));
+  LOG (GNUNET_ERROR_TYPE_INFO,
+       _("Service `%s' runs as %u processes\n"),
+       sctx->service_name,
+       sctx->num_workers + 1);
+  return GNUNET_OK;
+}
+
+
+/**
+ * Terminate and collect the worker processes (in the main process)
+ * and release the worker pipe.
+ *
+ * @param sctx service context
+ */
+static void
+stop_workers (struct GNUNET_SERVICE_Context *sctx)
+{
+  unsigned int i;
+
+  for (i = 0; i < sctx->num_workers; i++)
+    if ((0 != sctx->workers[i]) &&
+        (0 != kill (sctx->workers[i], GNUNET_TERM_SIG)))
+      LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "kill");
+  for (i = 0; i < sctx->num_workers; i++)
+    if ((0 != sctx->workers[i]) &&
+        (sctx->workers[i] != waitpid (sctx->workers[i], NULL, 0)))
+      LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "waitpid");
+  GNUNET_array_grow (sctx->workers, sctx->num_workers, 0);
+  if (NULL != sctx->worker_pipe)
+  {
+    GNUNET_DISK_pipe_close (sctx->worker_pipe);
+    sctx->worker_pipe = NULL;
+  }
+}
+#endif
+
+
 /**
  * Initial task for the service.
  *
@@ -1177,6 +1457,9 @@ service_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
     sctx->ret = GNUNET_SYSERR;
     return;
   }
+  if (GNUNET_YES == sctx->shm_ipc)
+    GNUNET_SERVER_enable_shm_ (sctx->server);
+  GNUNET_SERVER_set_client_budget (sctx->server, sctx->client_budget);
 #ifndef WINDOWS
   if (NULL != sctx->addrs)
     for (i = 0; NULL != sctx->addrs[i]; i++)
@@ -1196,6 +1479,21 @@ service_task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
                                                         &shutdown_task,
 							sctx);
   }
+#ifndef WINDOWS
+  if (NULL != sctx->worker_pipe)
+  {
+    if (GNUNET_YES == sctx->is_worker)
+      sctx->worker_task
+        = GNUNET_SCHEDULER_add_read_file (GNUNET_TIME_UNIT_FOREVER_REL,
+                                          GNUNET_DISK_pipe_handle (sctx->worker_pipe,
+                                                                   GNUNET_DISK_PIPE_END_READ),
+                                          &main_process_gone, sctx);
+    else
+      sctx->worker_task
+        = GNUNET_SCHEDULER_add_delayed (WORKER_CHECK_FREQUENCY,
+                                        &check_workers, sctx);
+  }
+#endif
   sctx->my_handlers = GNUNET_malloc (sizeof (defhandlers));
   memcpy (sctx->my_handlers, defhandlers, sizeof (defhandlers));
   i = 0;
@@ -1369,6 +1667,62 @@ pid_file_delete (struct GNUNET_SERVICE_Context *sctx)
 }
 
 
+#ifndef WINDOWS
+/**
+ * If ARM preforked us (see #GNUNET_SERVICE_PREFORK_ENV), block until
+ * ARM activates us via the control pipe.
+ *
+ * @return #GNUNET_OK to run the service, #GNUNET_NO if we were told to
+ *         terminate (or ARM went away) before we were activated
+ */
+static int
+wait_for_activation ()
+{
+  const char *env;
+  char *end;
+  unsigned long fd;
+  ssize_t ret;
+  char sig;
+
+  if (NULL == getenv (GNUNET_SERVICE_PREFORK_ENV))
+    return GNUNET_OK;
+  unsetenv (GNUNET_SERVICE_PREFORK_ENV);
+  /* the control pipe is installed by the scheduler later; see os_priority.c */
+  env = getenv ("GNUNET_OS_CONTROL_PIPE");
+  if ((NULL == env) || ('\0' == env[0]))
+  {
+    GNUNET_break (0);
+    return GNUNET_OK;
+  }
+  errno = 0;
+  fd = strtoul (env, &end, 16);
+  if ((0 != errno) || (env == end))
+  {
+    GNUNET_break (0);
+    return GNUNET_OK;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Preforked, waiting for activation\n");
+  while (1)
+  {
+    ret = READ ((int) fd, &sig, sizeof (sig));
+    if ((-1 == ret) && (EINTR == errno))
+      continue;
+    if (sizeof (sig) != ret)
+      break;
+    if (SIGCONT == sig)
+      return GNUNET_OK;
+    if ((GNUNET_TERM_SIG == sig) || (SIGTERM == sig) ||
+        (SIGINT == sig) || (SIGKILL == sig))
+      break;
+  }
+  LOG (GNUNET_ERROR_TYPE_DEBUG,
+       "Terminating without having been activated\n");
+  return GNUNET_NO;
+}
+#endif
+
+
 /**
  * Run a standard GNUnet service startup sequence (initialize loggers
  * and configuration, parse options).
@@ -1498,9 +1852,21 @@ GNUNET_SERVICE_run (int argc, char *const *argv,
     GNUNET_TIME_set_offset (clock_offset);
     LOG (GNUNET_ERROR_TYPE_DEBUG, "Skewing clock by %dll ms\n", clock_offset);
   }
+#ifndef WINDOWS
+  if (GNUNET_OK != wait_for_activation ())
+  {
+    err = 0;
+    goto shutdown;
+  }
+  if (GNUNET_OK != start_workers (&sctx))
+    HANDLE_ERROR;
+#endif
   /* actually run service */
   err = 0;
   GNUNET_SCHEDULER_run (&service_task, &sctx);
+#ifndef WINDOWS
+  stop_workers (&sctx);
+#endif
   /* shutdown */
   if ((1 == do_daemonize) && (NULL != sctx.server))
     pid_file_delete (&sctx);
@@ -1599,6 +1965,9 @@ GNUNET_SERVICE_start (const char *service_name,
     GNUNET_SERVICE_stop (sctx);
     return NULL;
   }
+  if (GNUNET_YES == sctx->shm_ipc)
+    GNUNET_SERVER_enable_shm_ (sctx->server);
+  GNUNET_SERVER_set_client_budget (sctx->server, sctx->client_budget);
 #ifndef WINDOWS
   if (NULL != sctx->addrs)
     for (i = 0; NULL != sctx->addrs[i]; i++)
@@ -0,0 +1,517 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file util/shm_ring.c
+ * @brief shared memory ring buffers for local connections
+ * @author Christian Grothoff
+ *
+ * A segment holds two single-producer single-consumer rings, one
+ * per direction.  Head and tail are free-running 32-bit counters;
+ * the other process may scribble over them, so we only ever trust
+ * them after checking that they describe at most one ring worth of
+ * data.  Wakeups are not handled here: a reader (or writer) that
+ * has to wait sets a flag in the ring, and the other side tells
+ * the caller to wake it up (connection.c uses the socket for that).
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "shm_ring.h"
+
+#define LOG(kind,...) GNUNET_log_from (kind, "util-shm", __VA_ARGS__)
+
+#define LOG_STRERROR(kind,syscall) GNUNET_log_from_strerror (kind, "util-shm", syscall)
+
+#if HAVE_SHM_OPEN && defined(SCM_RIGHTS) && !MINGW
+#define SHM_SUPPORTED 1
+#else
+#define SHM_SUPPORTED 0
+#endif
+
+
+/**
+ * Shared state of one ring.  Each group of fields is written by
+ * one side only and lives on its own cache line.
+ */
+struct RingHeader
+{
+  /**
+   * Number of bytes ever written, only modified by the writer.
+   */
+  volatile uint32_t head;
+
+  /**
+   * Keep @e tail on another cache line.
+   */
+  char pad0[60];
+
+  /**
+   * Number of bytes ever read, only modified by the reader.
+   */
+  volatile uint32_t tail;
+
+  /**
+   * Keep the flags on another cache line.
+   */
+  char pad1[60];
+
+  /**
+   * Non-zero if the reader found the ring empty and waits for a wakeup.
+   */
+  volatile uint32_t reader_waiting;
+
+  /**
+   * Non-zero if the writer found the ring full and waits for a wakeup.
+   */
+  volatile uint32_t writer_waiting;
+
+  /**
+   * Round up to a full cache line.
+   */
+  char pad2[56];
+};
+
+
+/**
+ * Total size of a segment: two headers followed by two rings.
+ */
+#define SEGMENT_SIZE (2 * (sizeof (struct RingHeader) + GNUNET_SHM_RING_SIZE))
+
+
+/**
+ * Handle for a shared memory segment with one ring per direction.
+ */
+struct GNUNET_SHM_Segment
+{
+  /**
+   * Start of the mapping, the two ring headers.
+   */
+  struct RingHeader *hdr;
+
+  /**
+   * Start of the data of the first ring; the second ring
+   * follows directly.
+   */
+  char *data;
+
+  /**
+   * File descriptor to pass to the other side, -1 once sent
+   * (or if we attached to the segment).
+   */
+  int fd;
+};
+
+
+#if SHM_SUPPORTED
+/**
+ * Map the segment behind @a fd.
+ *
+ * @param fd file descriptor of the segment, closed unless
+ *        this is a segment we still have to send
+ * @param keep_fd #GNUNET_YES to keep @a fd open for sending
+ * @return NULL on error
+ */
+static struct GNUNET_SHM_Segment *
+map_segment (int fd,
+             int keep_fd)
+{
+  struct GNUNET_SHM_Segment *seg;
+  void *mem;
+
+  mem = mmap (NULL, SEGMENT_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (MAP_FAILED == mem)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "mmap");
+    (void) close (fd);
+    return NULL;
+  }
+  if (GNUNET_YES != keep_fd)
+  {
+    (void) close (fd);
+    fd = -1;
+  }
+  seg = GNUNET_new (struct GNUNET_SHM_Segment);
+  seg->hdr = mem;
+  seg->data = (char *) &seg->hdr[2];
+  seg->fd = fd;
+  return seg;
+}
+#endif
+
+
+/**
+ * Create a new (anonymous) shared memory segment.
+ *
+ * @return NULL if shared memory is not supported or on error
+ */
+struct GNUNET_SHM_Segment *
+GNUNET_SHM_segment_create_ ()
+{
+#if SHM_SUPPORTED
+  char name[64];
+  int fd;
+
+  GNUNET_snprintf (name,
+                   sizeof (name),
+                   "/gnunet-shm-%u-%u",
+                   (unsigned int) getpid (),
+                   GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                             UINT32_MAX));
+  fd = shm_open (name, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+  if (-1 == fd)
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_DEBUG, "shm_open");
+    return NULL;
+  }
+  /* the other side gets the descriptor, nobody needs the name */
+  (void) shm_unlink (name);
+  if (0 != ftruncate (fd, SEGMENT_SIZE))
+  {
+    LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "ftruncate");
+    (void) close (fd);
+    return NULL;
+  }
+  return map_segment (fd, GNUNET_YES);
+#else
+  return NULL;
+#endif
+}
+
+
+/**
+ * Send @a buf over @a sock, passing the file descriptor of
+ * @a seg along with it.  Afterwards, the segment can no longer
+ * be sent again.
+ *
+ * @param seg segment created with #GNUNET_SHM_segment_create_()
+ * @param sock UNIX domain socket to send on
+ * @param buf data to send
+ * @param len number of bytes in @a buf
+ * @return number of bytes sent, -1 on error (errno is set)
+ */
+ssize_t
+GNUNET_SHM_segment_send_ (struct GNUNET_SHM_Segment *seg,
+                          struct GNUNET_NETWORK_Handle *sock,
+                          const void *buf,
+                          size_t len)
+{
+#if SHM_SUPPORTED
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE (sizeof (int))];
+  ssize_t ret;
+  int eno;
+
+  GNUNET_assert (-1 != seg->fd);
+  memset (&msg, 0, sizeof (msg));
+  memset (control, 0, sizeof (control));
+  iov.iov_base = (void *) buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &seg->fd, sizeof (int));
+  do
+  {
+    ret = sendmsg (GNUNET_NETWORK_get_fd (sock), &msg, MSG_DONTWAIT
+#ifdef MSG_NOSIGNAL
+                   | MSG_NOSIGNAL
+#endif
+                   );
+  }
+  while ((-1 == ret) && (EINTR == errno));
+  eno = errno;
+  (void) close (seg->fd);
+  seg->fd = -1;
+  errno = eno;
+  return ret;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+
+/**
+ * Receive up to @a len bytes from @a sock.  If the other side passed
+ * a segment along with the data, attach to it and store it in
+ * @a seg (unless @a seg already holds a segment, in which case the
+ * new one is ignored).
+ *
+ * @param sock UNIX domain socket to receive from
+ * @param buf where to store the data
+ * @param len size of @a buf
+ * @param seg where to store a segment we received, NULL to
+ *        ignore segments
+ * @return number of bytes received, -1 on error (errno is set)
+ */
+ssize_t
+GNUNET_SHM_segment_recv_ (struct GNUNET_NETWORK_Handle *sock,
+                          void *buf,
+                          size_t len,
+                          struct GNUNET_SHM_Segment **seg)
+{
+#if SHM_SUPPORTED
+  struct msghdr msg;
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  char control[CMSG_SPACE (sizeof (int))];
+  struct stat st;
+  ssize_t ret;
+  int fd;
+
+  memset (&msg, 0, sizeof (msg));
+  iov.iov_base = buf;
+  iov.iov_len = len;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof (control);
+  ret = recvmsg (GNUNET_NETWORK_get_fd (sock), &msg, MSG_DONTWAIT);
+  if (-1 == ret)
+    return -1;
+  for (cmsg = CMSG_FIRSTHDR (&msg); NULL != cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+  {
+    if ((SOL_SOCKET != cmsg->cmsg_level) ||
+        (SCM_RIGHTS != cmsg->cmsg_type) ||
+        (CMSG_LEN (sizeof (int)) != cmsg->cmsg_len))
+      continue;
+    memcpy (&fd, CMSG_DATA (cmsg), sizeof (int));
+    if ((NULL == seg) || (NULL != *seg))
+    {
+      GNUNET_break_op (0);
+      (void) close (fd);
+      continue;
+    }
+    if ((0 != fstat (fd, &st)) ||
+        (SEGMENT_SIZE != (size_t) st.st_size))
+    {
+      GNUNET_break_op (0);
+      (void) close (fd);
+      continue;
+    }
+    *seg = map_segment (fd, GNUNET_NO);
+  }
+  return ret;
+#else
+  return GNUNET_NETWORK_socket_recv (sock, buf, len);
+#endif
+}
+
+
+/**
+ * Unmap and release a segment.
+ *
+ * @param seg segment to release
+ */
+void
+GNUNET_SHM_segment_destroy_ (struct GNUNET_SHM_Segment *seg)
+{
+#if SHM_SUPPORTED
+  if (-1 != seg->fd)
+    (void) close (seg->fd);
+  if (0 != munmap (seg->hdr, SEGMENT_SIZE))
+    LOG_STRERROR (GNUNET_ERROR_TYPE_WARNING, "munmap");
+#endif
+  GNUNET_free (seg);
+}
+
+
+/**
+ * Copy as much of @a buf into ring @a dir as fits.
+ *
+ * @param seg segment to use
+ * @param dir ring to write to
+ * @param buf data to write
+ * @param size number of bytes in @a buf
+ * @return number of bytes written, -1 if the ring is corrupt
+ */
+ssize_t
+GNUNET_SHM_ring_write_ (struct GNUNET_SHM_Segment *seg,
+                        enum GNUNET_SHM_Direction dir,
+                        const void *buf,
+                        size_t size)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+  char *data = &seg->data[dir * GNUNET_SHM_RING_SIZE];
+  uint32_t head;
+  uint32_t used;
+  size_t off;
+  size_t first;
+
+  head = rh->head;
+  used = head - rh->tail;
+  if (used > GNUNET_SHM_RING_SIZE)
+    return -1;
+  size = GNUNET_MIN (size, GNUNET_SHM_RING_SIZE - used);
+  if (0 == size)
+    return 0;
+  off = head & (GNUNET_SHM_RING_SIZE - 1);
+  first = GNUNET_MIN (size, GNUNET_SHM_RING_SIZE - off);
+  memcpy (&data[off], buf, first);
+  memcpy (data, &((const char *) buf)[first], size - first);
+  /* data must be visible before the new head */
+  __sync_synchronize ();
+  rh->head = head + size;
+  return size;
+}
+
+
+/**
+ * Copy up to @a size bytes from ring @a dir into @a buf.
+ *
+ * @param seg segment to use
+ * @param dir ring to read from
+ * @param buf where to store the data
+ * @param size size of @a buf
+ * @return number of bytes read, -1 if the ring is corrupt
+ */
+ssize_t
+GNUNET_SHM_ring_read_ (struct GNUNET_SHM_Segment *seg,
+                       enum GNUNET_SHM_Direction dir,
+                       void *buf,
+                       size_t size)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+  const char *data = &seg->data[dir * GNUNET_SHM_RING_SIZE];
+  uint32_t tail;
+  uint32_t used;
+  size_t off;
+  size_t first;
+
+  tail = rh->tail;
+  used = rh->head - tail;
+  /* do not read data older than the head we just saw */
+  __sync_synchronize ();
+  if (used > GNUNET_SHM_RING_SIZE)
+    return -1;
+  size = GNUNET_MIN (size, used);
+  if (0 == size)
+    return 0;
+  off = tail & (GNUNET_SHM_RING_SIZE - 1);
+  first = GNUNET_MIN (size, GNUNET_SHM_RING_SIZE - off);
+  memcpy (buf, &data[off], first);
+  memcpy (&((char *) buf)[first], data, size - first);
+  /* finish copying before the writer may reuse the space */
+  __sync_synchronize ();
+  rh->tail = tail + size;
+  return size;
+}
+
+
+/**
+ * The reader found ring @a dir empty.  Ask the writer to wake us up
+ * once it wrote more data.
+ *
+ * @param seg segment to use
+ * @param dir ring we read from
+ * @return #GNUNET_YES if data arrived in the meantime (no wakeup
+ *         will be sent), #GNUNET_NO if we must wait for the wakeup
+ */
+int
+GNUNET_SHM_ring_wait_read_ (struct GNUNET_SHM_Segment *seg,
+                            enum GNUNET_SHM_Direction dir)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+
+  rh->reader_waiting = 1;
+  __sync_synchronize ();
+  if (rh->head == rh->tail)
+    return GNUNET_NO;
+  rh->reader_waiting = 0;
+  return GNUNET_YES;
+}
+
+
+/**
+ * The writer found ring @a dir full.  Ask the reader to wake us up
+ * once it made room.
+ *
+ * @param seg segment to use
+ * @param dir ring we write to
+ * @return #GNUNET_YES if room became available in the meantime (no
+ *         wakeup will be sent), #GNUNET_NO if we must wait for the wakeup
+ */
+int
+GNUNET_SHM_ring_wait_write_ (struct GNUNET_SHM_Segment *seg,
+                             enum GNUNET_SHM_Direction dir)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+
+  rh->writer_waiting = 1;
+  __sync_synchronize ();
+  if (rh->head - rh->tail >= GNUNET_SHM_RING_SIZE)
+    return GNUNET_NO;
+  rh->writer_waiting = 0;
+  return GNUNET_YES;
+}
+
+
+/**
+ * We wrote to ring @a dir.  Check if the reader is waiting for a
+ * wakeup (and clear the request).
+ *
+ * @param seg segment to use
+ * @param dir ring we wrote to
+ * @return #GNUNET_YES if the caller must wake up the reader
+ */
+int
+GNUNET_SHM_ring_test_reader_ (struct GNUNET_SHM_Segment *seg,
+                              enum GNUNET_SHM_Direction dir)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+
+  __sync_synchronize ();
+  if (0 == rh->reader_waiting)
+    return GNUNET_NO;
+  return (0 != __sync_lock_test_and_set (&rh->reader_waiting, 0))
+    ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/**
+ * We read from ring @a dir.  Check if the writer is waiting for a
+ * wakeup (and clear the request).
+ *
+ * @param seg segment to use
+ * @param dir ring we read from
+ * @return #GNUNET_YES if the caller must wake up the writer
+ */
+int
+GNUNET_SHM_ring_test_writer_ (struct GNUNET_SHM_Segment *seg,
+                              enum GNUNET_SHM_Direction dir)
+{
+  struct RingHeader *rh = &seg->hdr[dir];
+
+  __sync_synchronize ();
+  if (0 == rh->writer_waiting)
+    return GNUNET_NO;
+  return (0 != __sync_lock_test_and_set (&rh->writer_waiting, 0))
+    ? GNUNET_YES : GNUNET_NO;
+}
+
+
+/* end of shm_ring.c */
@@ -0,0 +1,202 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+
+/**
+ * @file util/shm_ring.h
+ * @brief shared memory ring buffers for local connections
+ * @author Christian Grothoff
+ */
+
+#ifndef SHM_RING_H_
+#define SHM_RING_H_
+
+/**
+ * Size of each of the two rings of a segment, must be a power of two.
+ */
+#define GNUNET_SHM_RING_SIZE (256 * 1024)
+
+
+/**
+ * The two rings of a segment.
+ */
+enum GNUNET_SHM_Direction
+{
+  /**
+   * Ring written by the client that created the segment.
+   */
+  GNUNET_SHM_CLIENT_TO_SERVICE = 0,
+
+  /**
+   * Ring written by the service that attached to the segment.
+   */
+  GNUNET_SHM_SERVICE_TO_CLIENT = 1
+};
+
+
+/**
+ * Handle for a shared memory segment with one ring per direction.
+ */
+struct GNUNET_SHM_Segment;
+
+
+/**
+ * Create a new (anonymous) shared memory segment.
+ *
+ * @return NULL if shared memory is not supported or on error
+ */
+struct GNUNET_SHM_Segment *
+GNUNET_SHM_segment_create_ (void);
+
+
+/**
+ * Send @a buf over @a sock, passing the file descriptor of
+ * @a seg along with it.  Afterwards, the segment can no longer
+ * be sent again.
+ *
+ * @param seg segment created with #GNUNET_SHM_segment_create_()
+ * @param sock UNIX domain socket to send on
+ * @param buf data to send
+ * @param len number of bytes in @a buf
+ * @return number of bytes sent, -1 on error (errno is set)
+ */
+ssize_t
+GNUNET_SHM_segment_send_ (struct GNUNET_SHM_Segment *seg,
+                          struct GNUNET_NETWORK_Handle *sock,
+                          const void *buf,
+                          size_t len);
+
+
+/**
+ * Receive up to @a len bytes from @a sock.  If the other side passed
+ * a segment along with the data, attach to it and store it in
+ * @a seg (unless @a seg already holds a segment, in which case the
+ * new one is ignored).
+ *
+ * @param sock UNIX domain socket to receive from
+ * @param buf where to store the data
+ * @param len size of @a buf
+ * @param seg where to store a segment we received, NULL to
+ *        ignore segments
+ * @return number of bytes received, -1 on error (errno is set)
+ */
+ssize_t
+GNUNET_SHM_segment_recv_ (struct GNUNET_NETWORK_Handle *sock,
+                          void *buf,
+                          size_t len,
+                          struct GNUNET_SHM_Segment **seg);
+
+
+/**
+ * Unmap and release a segment.
+ *
+ * @param seg segment to release
+ */
+void
+GNUNET_SHM_segment_destroy_ (struct GNUNET_SHM_Segment *seg);
+
+
+/**
+ * Copy as much of @a buf into ring @a dir as fits.
+ *
+ * @param seg segment to use
+ * @param dir ring to write to
+ * @param buf data to write
+ * @param size number of bytes in @a buf
+ * @return number of bytes written, -1 if the ring is corrupt
+ */
+ssize_t
+GNUNET_SHM_ring_write_ (struct GNUNET_SHM_Segment *seg,
+                        enum GNUNET_SHM_Direction dir,
+                        const void *buf,
+                        size_t size);
+
+
+/**
+ * Copy up to @a size bytes from ring @a dir into @a buf.
+ *
+ * @param seg segment to use
+ * @param dir ring to read from
+ * @param buf where to store the data
+ * @param size size of @a buf
+ * @return number of bytes read, -1 if the ring is corrupt
+ */
+ssize_t
+GNUNET_SHM_ring_read_ (struct GNUNET_SHM_Segment *seg,
+                       enum GNUNET_SHM_Direction dir,
+                       void *buf,
+                       size_t size);
+
+
+/**
+ * The reader found ring @a dir empty.  Ask the writer to wake us up
+ * once it wrote more data.
+ *
+ * @param seg segment to use
+ * @param dir ring we read from
+ * @return #GNUNET_YES if data arrived in the meantime (no wakeup
+ *         will be sent), #GNUNET_NO if we must wait for the wakeup
+ */
+int
+GNUNET_SHM_ring_wait_read_ (struct GNUNET_SHM_Segment *seg,
+                            enum GNUNET_SHM_Direction dir);
+
+
+/**
+ * The writer found ring @a dir full.  Ask the reader to wake us up
+ * once it made room.
+ *
+ * @param seg segment to use
+ * @param dir ring we write to
+ * @return #GNUNET_YES if room became available in the meantime (no
+ *         wakeup will be sent), #GNUNET_NO if we must wait for the wakeup
+ */
+int
+GNUNET_SHM_ring_wait_write_ (struct GNUNET_SHM_Segment *seg,
+                             enum GNUNET_SHM_Direction dir);
+
+
+/**
+ * We wrote to ring @a dir.  Check if the reader is waiting for a
+ * wakeup (and clear the request).
+ *
+ * @param seg segment to use
+ * @param dir ring we wrote to
+ * @return #GNUNET_YES if the caller must wake up the reader
+ */
+int
+GNUNET_SHM_ring_test_reader_ (struct GNUNET_SHM_Segment *seg,
+                              enum GNUNET_SHM_Direction dir);
+
+
+/**
+ * We read from ring @a dir.  Check if the writer is waiting for a
+ * wakeup (and clear the request).
+ *
+ * @param seg segment to use
+ * @param dir ring we read from
+ * @return #GNUNET_YES if the caller must wake up the writer
+ */
+int
+GNUNET_SHM_ring_test_writer_ (struct GNUNET_SHM_Segment *seg,
+                              enum GNUNET_SHM_Direction dir);
+
+
+#endif
+/* end of shm_ring.h */
@@ -785,57 +785,49 @@ GNUNET_STRINGS_get_short_name (const char *filename)
 }
 
 
+/**
+ * Decoding table for Crockford Base32: maps each character to its
+ * numeric value, or -1 if the character is not part of the alphabet.
+ * Lower case letters are accepted, 'O' is read as '0', 'I' and 'L'
+ * as '1' and 'U' as 'V'.
+ */
+static const signed char decTable__[256] = {
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, -1, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 1, 18, 19, 1, 20, 21, 0,
+  22, 23, 24, 25, 26, 27, 27, 28, 29, 30, 31, -1, -1, -1, -1, -1,
+  -1, 10, 11, 12, 13, 14, 15, 16, 17, 1, 18, 19, 1, 20, 21, 0,
+  22, 23, 24, 25, 26, 27, 27, 28, 29, 30, 31, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+  -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+};
+
+
+/**
+ * Encoding table for Crockford Base32.
+ */
+static const char encTable__[] = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
+
+
 /**
  * Get the decoded value corresponding to a character according to Crockford
  * Base32 encoding.
  *
  * @param a a character
- * @return corresponding numeric value
+ * @return corresponding numeric value, -1 on invalid characters
  */
-static unsigned int
+static int
 getValue__ (unsigned char a)
 {
-  unsigned int dec;
-
-  switch (a)
-  {
-  case 'O':
-  case 'o':
-    a = '0';
-    break;
-  case 'i':
-  case 'I':
-  case 'l':
-  case 'L':
-    a = '1';
-    break;
-    /* also consider U to be V */
-  case 'u':
-  case 'U':
-    a = 'V';
-    break;
-  default:
-    break;
-  }
-  if ((a >= '0') && (a <= '9'))
-    return a - '0';
-  if ((a >= 'a') && (a <= 'z'))
-    a = toupper (a);
-    /* return (a - 'a' + 10); */
-  dec = 0;
-  if ((a >= 'A') && (a <= 'Z'))
-  {
-    if ('I' < a)
-      dec++;
-    if ('L' < a)
-      dec++;
-    if ('O' < a)
-      dec++;
-    if ('U' < a)
-      dec++;
-    return (a - 'A' + 10 - dec);
-  }
-  return -1;
+  return decTable__[a];
 }
 
 
@@ -857,14 +849,11 @@ GNUNET_STRINGS_data_to_string (const void *data,
                                char *out,
                                size_t out_size)
 {
-  /**
-   * 32 characters for encoding
-   */
-  static char *encTable__ = "0123456789ABCDEFGHJKMNPQRSTVWXYZ";
   unsigned int wpos;
   unsigned int rpos;
   unsigned int bits;
   unsigned int vbit;
+  uint64_t group;
   const unsigned char *udata;
 
   udata = data;
@@ -877,6 +866,26 @@ GNUNET_STRINGS_data_to_string (const void *data,
   wpos = 0;
   rpos = 0;
   bits = 0;
+  /* fast path: every 5 bytes of input yield exactly 8 characters */
+  while (rpos + 5 <= size)
+  {
+    group = ((uint64_t) udata[rpos] << 32)
+      | ((uint64_t) udata[rpos + 1] << 24)
+      | ((uint64_t) udata[rpos + 2] << 16)
+      | ((uint64_t) udata[rpos + 3] << 8)
+      | (uint64_t) udata[rpos + 4];
+    out[wpos] = encTable__[(group >> 35) & 31];
+    out[wpos + 1] = encTable__[(group >> 30) & 31];
+    out[wpos + 2] = encTable__[(group >> 25) & 31];
+    out[wpos + 3] = encTable__[(group >> 20) & 31];
+    out[wpos + 4] = encTable__[(group >> 15) & 31];
+    out[wpos + 5] = encTable__[(group >> 10) & 31];
+    out[wpos + 6] = encTable__[(group >> 5) & 31];
+    out[wpos + 7] = encTable__[group & 31];
+    rpos += 5;
+    wpos += 8;
+  }
+  /* remaining 0-4 bytes, bit by bit */
   while ((rpos < size) || (vbit > 0))
   {
     if ((rpos < size) && (vbit < 5))
@@ -956,9 +965,14 @@ GNUNET_STRINGS_string_to_data (const char *enc, size_t enclen,
   unsigned int wpos;
   unsigned int bits;
   unsigned int vbit;
+  unsigned int groups;
+  unsigned int g;
+  unsigned int j;
+  uint64_t group;
   int ret;
   int shift;
   unsigned char *uout;
+  const unsigned char *uenc;
   unsigned int encoded_len = out_size * 8;
 
   if (0 == enclen)
@@ -967,7 +981,30 @@ GNUNET_STRINGS_string_to_data (const char *enc, size_t enclen,
       return GNUNET_OK;
     return GNUNET_SYSERR;
   }
+  if ((encoded_len + 4) / 5 != enclen)
+    return GNUNET_SYSERR;
   uout = out;
+  uenc = (const unsigned char *) enc;
+  /* 8 characters encode exactly 5 bytes; decode all but the last
+   * (possibly padded) group in one go, front to back */
+  groups = (0 == out_size) ? 0 : (out_size - 1) / 5;
+  for (g = 0; g < groups; g++)
+  {
+    group = 0;
+    for (j = 0; j < 8; j++)
+    {
+      ret = decTable__[uenc[8 * g + j]];
+      if (-1 == ret)
+        return GNUNET_SYSERR;
+      group = (group << 5) | (uint64_t) ret;
+    }
+    uout[5 * g] = (unsigned char) (group >> 32);
+    uout[5 * g + 1] = (unsigned char) (group >> 24);
+    uout[5 * g + 2] = (unsigned char) (group >> 16);
+    uout[5 * g + 3] = (unsigned char) (group >> 8);
+    uout[5 * g + 4] = (unsigned char) group;
+  }
+  /* the tail is decoded back to front, bit by bit */
   wpos = out_size;
   rpos = enclen;
   if ((encoded_len % 5) > 0)
@@ -986,9 +1023,9 @@ GNUNET_STRINGS_string_to_data (const char *enc, size_t enclen,
     return GNUNET_SYSERR;
   if (-1 == ret)
     return GNUNET_SYSERR;
-  while (wpos > 0)
+  while (wpos > 5 * groups)
   {
-    if (0 == rpos)
+    if (8 * groups == rpos)
     {
       GNUNET_break (0);
       return GNUNET_SYSERR;
@@ -1004,7 +1041,7 @@ GNUNET_STRINGS_string_to_data (const char *enc, size_t enclen,
       vbit -= 8;
     }
   }
-  if ( (0 != rpos) ||
+  if ( (8 * groups != rpos) ||
        (0 != vbit) )
     return GNUNET_SYSERR;
   return GNUNET_OK;
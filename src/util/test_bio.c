@@ -76,6 +76,43 @@ test_normal_rw ()
   return 0;
 }
 
+static int
+test_span_r ()
+{
+  char *msg;
+  const void *span;
+  int32_t testNum;
+  char *fileName = GNUNET_DISK_mktemp ("gnunet_bio");
+  struct GNUNET_BIO_WriteHandle *fileW;
+  struct GNUNET_BIO_ReadHandle *fileR;
+
+  fileW = GNUNET_BIO_write_open (fileName);
+  GNUNET_assert (NULL != fileW);
+  GNUNET_assert (GNUNET_OK == GNUNET_BIO_write_int32 (fileW, 42));
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_BIO_write (fileW, TESTSTRING, strlen (TESTSTRING)));
+  GNUNET_assert (GNUNET_OK == GNUNET_BIO_write_close (fileW));
+
+  fileR = GNUNET_BIO_read_open (fileName);
+  GNUNET_assert (NULL != fileR);
+  GNUNET_assert (GNUNET_OK == GNUNET_BIO_read_int32 (fileR, &testNum));
+  GNUNET_assert (42 == testNum);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_BIO_read_span (fileR, "Read span error",
+                                       &span, strlen (TESTSTRING)));
+  GNUNET_assert (0 == memcmp (span, TESTSTRING, strlen (TESTSTRING)));
+  /* reading past the end must fail */
+  GNUNET_assert (GNUNET_SYSERR ==
+                 GNUNET_BIO_read_span (fileR, "Read span error",
+                                       &span, 1));
+  GNUNET_assert (GNUNET_SYSERR == GNUNET_BIO_read_close (fileR, &msg));
+  GNUNET_free (msg);
+  GNUNET_assert (GNUNET_OK == GNUNET_DISK_directory_remove (fileName));
+  GNUNET_free (fileName);
+  return 0;
+}
+
+
 static int
 test_nullstring_rw ()
 {
@@ -398,6 +435,7 @@ static int
 check_file_rw ()
 {
   GNUNET_assert (0 == test_normal_rw ());
+  GNUNET_assert (0 == test_span_r ());
   GNUNET_assert (0 == test_nullfile_rw ());
   GNUNET_assert (0 == test_fullfile_rw ());
   GNUNET_assert (0 == test_directory_r ());
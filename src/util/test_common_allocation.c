@@ -93,6 +93,39 @@ check ()
   if (ptrs[0] != NULL)
     return 9;
 
+  /* GNUNET_pool_malloc/GNUNET_pool_free tests */
+  {
+    struct GNUNET_MemoryPool *pool = NULL;
+
+    for (i = 0; i < MAX_TESTVAL; i++)
+    {
+      ptrs[i] = GNUNET_pool_malloc (pool, 32);
+      for (j = 0; j < 32; j++)
+        if (0 != ptrs[i][j])
+          return 10;
+      memset (ptrs[i], i, 32);
+    }
+    for (i = 0; i < MAX_TESTVAL; i += 2)
+      GNUNET_pool_free (pool, ptrs[i]);
+    for (i = 0; i < MAX_TESTVAL; i += 2)
+    {
+      /* blocks from the free list must be zero'ed again */
+      ptrs[i] = GNUNET_pool_malloc (pool, 32);
+      for (j = 0; j < 32; j++)
+        if (0 != ptrs[i][j])
+          return 11;
+    }
+    for (i = 1; i < MAX_TESTVAL; i += 2)
+      for (j = 0; j < 32; j++)
+        if ((char) i != ptrs[i][j])
+          return 12;
+    for (i = 0; i < MAX_TESTVAL; i++)
+      GNUNET_pool_free (pool, ptrs[i]);
+    GNUNET_pool_destroy (pool);
+    if (NULL != pool)
+      return 13;
+  }
+
 
   return 0;
 }
@@ -351,6 +351,57 @@ static const char *want[] = {
   NULL,
 };
 
+static int
+testSnapshot ()
+{
+  struct GNUNET_CONFIGURATION_Handle *parsed;
+  struct GNUNET_CONFIGURATION_Handle *loaded;
+  char *snapshot;
+  char *m1;
+  char *m2;
+  size_t s1;
+  size_t s2;
+  int ret;
+
+  ret = 0;
+  snapshot = GNUNET_DISK_mktemp ("test-configuration-snapshot");
+  GNUNET_assert (NULL != snapshot);
+  if (GNUNET_OK !=
+      GNUNET_CONFIGURATION_snapshot_write (snapshot,
+                                           "test_configuration_data.conf"))
+  {
+    GNUNET_break (0);
+    ret = 1;
+  }
+  parsed = GNUNET_CONFIGURATION_create ();
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_load (parsed,
+                                            "test_configuration_data.conf"));
+  setenv (GNUNET_CONFIGURATION_SNAPSHOT_ENV, snapshot, 1);
+  loaded = GNUNET_CONFIGURATION_create ();
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CONFIGURATION_load (loaded,
+                                            "test_configuration_data.conf"));
+  unsetenv (GNUNET_CONFIGURATION_SNAPSHOT_ENV);
+  /* same options, in the same order */
+  m1 = GNUNET_CONFIGURATION_serialize (parsed, &s1);
+  m2 = GNUNET_CONFIGURATION_serialize (loaded, &s2);
+  if ( (s1 != s2) ||
+       (0 != memcmp (m1, m2, s1)) )
+  {
+    GNUNET_break (0);
+    ret = 1;
+  }
+  GNUNET_free (m1);
+  GNUNET_free (m2);
+  GNUNET_CONFIGURATION_destroy (parsed);
+  GNUNET_CONFIGURATION_destroy (loaded);
+  GNUNET_break (0 == UNLINK (snapshot));
+  GNUNET_free (snapshot);
+  return ret;
+}
+
+
 static int
 check (void *data, const char *fn)
 {
@@ -513,6 +564,10 @@ main (int argc, char *argv[])
   GNUNET_free (c);
   GNUNET_CONFIGURATION_destroy (cfg);
 
+  failureCount += testSnapshot ();
+  if (failureCount > 0)
+    goto error;
+
   /* Testing configuration diffs */
   cfg_default = GNUNET_CONFIGURATION_create ();
   if (GNUNET_OK != GNUNET_CONFIGURATION_load (cfg_default, NULL))
@@ -0,0 +1,227 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_connection_transmit_messages.c
+ * @brief tests for GNUNET_CONNECTION_transmit_messages()
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+#define PORT 12435
+
+/**
+ * Number of messages we transmit.
+ */
+#define NUM_MESSAGES 3
+
+/**
+ * Size of the buffer holding the messages.
+ */
+#define TOTAL_SIZE (sizeof (struct GNUNET_MessageHeader) + 100 + 60000 + 4)
+
+
+static struct GNUNET_CONNECTION_Handle *csock;
+
+static struct GNUNET_CONNECTION_Handle *asock;
+
+static struct GNUNET_CONNECTION_Handle *lsock;
+
+static struct GNUNET_NETWORK_Handle *ls;
+
+static struct GNUNET_CONFIGURATION_Handle *cfg;
+
+/**
+ * The bytes we transmit: a message written the usual way, followed
+ * by the #NUM_MESSAGES messages handed over without copying.
+ */
+static char sent[TOTAL_SIZE];
+
+/**
+ * Pointers to the messages in #sent.
+ */
+static const struct GNUNET_MessageHeader *msgs[NUM_MESSAGES];
+
+/**
+ * Number of bytes received so far.
+ */
+static size_t sofar;
+
+/**
+ * Set once the transmission continuation was called.
+ */
+static int cont_called;
+
+
+/**
+ * Create and initialize a listen socket for the server.
+ *
+ * @return -1 on error, otherwise the listen socket
+ */
+static struct GNUNET_NETWORK_Handle *
+open_listen_socket ()
+{
+  const static int on = 1;
+  struct sockaddr_in sa;
+  struct GNUNET_NETWORK_Handle *desc;
+
+  memset (&sa, 0, sizeof (sa));
+#if HAVE_SOCKADDR_IN_SIN_LEN
+  sa.sin_len = sizeof (sa);
+#endif
+  sa.sin_port = htons (PORT);
+  sa.sin_family = AF_INET;
+  desc = GNUNET_NETWORK_socket_create (AF_INET, SOCK_STREAM, 0);
+  GNUNET_assert (desc != NULL);
+  if (GNUNET_NETWORK_socket_setsockopt
+      (desc, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) != GNUNET_OK)
+    GNUNET_log (GNUNET_ERROR_TYPE_ERROR | GNUNET_ERROR_TYPE_BULK, "setsockopt");
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_NETWORK_socket_bind (desc, (const struct sockaddr *) &sa,
+					     sizeof (sa)));
+  GNUNET_NETWORK_socket_listen (desc, 5);
+  return desc;
+}
+
+
+static void
+receive_check (void *cls, const void *buf, size_t available,
+               const struct sockaddr *addr, socklen_t addrlen, int errCode)
+{
+  int *ok = cls;
+
+  GNUNET_assert (buf != NULL);  /* no timeout */
+  GNUNET_assert (sofar + available <= TOTAL_SIZE);
+  GNUNET_assert (0 == memcmp (&sent[sofar], buf, available));
+  sofar += available;
+  if (sofar < TOTAL_SIZE)
+  {
+    GNUNET_CONNECTION_receive (asock, TOTAL_SIZE - sofar,
+                               GNUNET_TIME_relative_multiply
+                               (GNUNET_TIME_UNIT_SECONDS, 5), &receive_check,
+                               cls);
+    return;
+  }
+  if (GNUNET_YES == cont_called)
+    *ok = 0;
+  GNUNET_CONNECTION_destroy (asock);
+  GNUNET_CONNECTION_destroy (csock);
+}
+
+
+static void
+run_accept (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  asock = GNUNET_CONNECTION_create_from_accept (NULL, NULL, ls);
+  GNUNET_assert (asock != NULL);
+  GNUNET_assert (GNUNET_YES == GNUNET_CONNECTION_check (asock));
+  GNUNET_CONNECTION_destroy (lsock);
+  GNUNET_CONNECTION_receive (asock, TOTAL_SIZE,
+                             GNUNET_TIME_relative_multiply
+                             (GNUNET_TIME_UNIT_SECONDS, 5), &receive_check,
+                             cls);
+}
+
+
+static void
+messages_sent (void *cls, int result)
+{
+  GNUNET_assert (GNUNET_OK == result);
+  GNUNET_assert (GNUNET_NO == cont_called);
+  cont_called = GNUNET_YES;
+}
+
+
+static size_t
+make_first (void *cls, size_t size, void *buf)
+{
+  GNUNET_assert (size >= sizeof (struct GNUNET_MessageHeader));
+  memcpy (buf, sent, sizeof (struct GNUNET_MessageHeader));
+  /* queue the others while the first is still in the write buffer */
+  GNUNET_assert (NULL !=
+                 GNUNET_CONNECTION_transmit_messages (csock, msgs, NUM_MESSAGES,
+                                                      GNUNET_TIME_UNIT_SECONDS,
+                                                      &messages_sent, NULL));
+  return sizeof (struct GNUNET_MessageHeader);
+}
+
+
+static void
+init_messages ()
+{
+  static const uint16_t sizes[NUM_MESSAGES] = { 100, 60000, 4 };
+  struct GNUNET_MessageHeader *hdr;
+  size_t off;
+  unsigned int i;
+
+  for (off = 0; off < TOTAL_SIZE; off++)
+    sent[off] = (char) off;
+  hdr = (struct GNUNET_MessageHeader *) sent;
+  hdr->size = htons (sizeof (struct GNUNET_MessageHeader));
+  hdr->type = htons (1);
+  off = sizeof (struct GNUNET_MessageHeader);
+  for (i = 0; i < NUM_MESSAGES; i++)
+  {
+    hdr = (struct GNUNET_MessageHeader *) &sent[off];
+    hdr->size = htons (sizes[i]);
+    hdr->type = htons (2 + i);
+    msgs[i] = hdr;
+    off += sizes[i];
+  }
+  GNUNET_assert (TOTAL_SIZE == off);
+}
+
+
+static void
+task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  init_messages ();
+  ls = open_listen_socket ();
+  lsock = GNUNET_CONNECTION_create_from_existing (ls);
+  GNUNET_assert (lsock != NULL);
+  csock = GNUNET_CONNECTION_create_from_connect (cfg, "localhost", PORT);
+  GNUNET_assert (csock != NULL);
+  GNUNET_assert (NULL !=
+                 GNUNET_CONNECTION_notify_transmit_ready (csock,
+                                                          sizeof (struct GNUNET_MessageHeader),
+                                                          GNUNET_TIME_UNIT_SECONDS,
+                                                          &make_first, NULL));
+  GNUNET_SCHEDULER_add_read_net (GNUNET_TIME_UNIT_FOREVER_REL, ls, &run_accept,
+                                 cls);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  int ok;
+
+  GNUNET_log_setup ("test_connection_transmit_messages",
+                    "WARNING",
+                    NULL);
+  ok = 1;
+  cfg = GNUNET_CONFIGURATION_create ();
+  GNUNET_CONFIGURATION_set_value_string (cfg, "resolver", "HOSTNAME",
+                                         "localhost");
+  GNUNET_SCHEDULER_run (&task, &ok);
+  GNUNET_CONFIGURATION_destroy (cfg);
+  return ok;
+}
+
+/* end of test_connection_transmit_messages.c */
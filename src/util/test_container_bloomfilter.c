@@ -53,6 +53,170 @@ add_iterator (void *cls, struct GNUNET_HashCode * next)
   return GNUNET_YES;
 }
 
+
+/**
+ * Test the blocked variant: membership, false positive rate, removal
+ * with a counter file, copy and or.
+ *
+ * @return 0 on success
+ */
+static int
+test_blocked ()
+{
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  struct GNUNET_CONTAINER_BloomFilter *bfc;
+  struct GNUNET_CONTAINER_BloomFilter *bfo;
+  struct GNUNET_HashCode tmp;
+  int i;
+  int ok1;
+  int ok2;
+  int falseok;
+  struct stat sbuf;
+
+  if (NULL != GNUNET_CONTAINER_bloomfilter_init_blocked (NULL, 100, K))
+    return 1;
+  if (0 == STAT (TESTFILE, &sbuf))
+    if (0 != UNLINK (TESTFILE))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "unlink", TESTFILE);
+  bf = GNUNET_CONTAINER_bloomfilter_load_blocked (TESTFILE, SIZE, K);
+  GNUNET_assert (NULL != bf);
+  GNUNET_CRYPTO_seed_weak_random (4);
+  for (i = 0; i < 2000; i++)
+  {
+    nextHC (&tmp);
+    GNUNET_CONTAINER_bloomfilter_add (bf, &tmp);
+  }
+  bfc = GNUNET_CONTAINER_bloomfilter_copy (bf);
+  GNUNET_CRYPTO_seed_weak_random (4);
+  for (i = 0; i < 1000; i++)
+  {
+    nextHC (&tmp);
+    GNUNET_CONTAINER_bloomfilter_remove (bf, &tmp);
+  }
+  GNUNET_CRYPTO_seed_weak_random (4);
+  ok1 = 0;
+  ok2 = 0;
+  for (i = 0; i < 2000; i++)
+  {
+    nextHC (&tmp);
+    if (GNUNET_CONTAINER_bloomfilter_test (bf, &tmp) == GNUNET_YES)
+      ok1++;
+    if (GNUNET_CONTAINER_bloomfilter_test (bfc, &tmp) == GNUNET_YES)
+      ok2++;
+  }
+  /* removed elements may still show up as false positives */
+  if ( (ok1 < 1000) || (ok1 > 1100) || (ok2 != 2000) )
+  {
+    printf ("Blocked filter: got %d/%d elements, expected 1000/2000\n",
+            ok1, ok2);
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    GNUNET_CONTAINER_bloomfilter_free (bfc);
+    return 1;
+  }
+  falseok = 0;
+  for (i = 0; i < 10000; i++)
+  {
+    nextHC (&tmp);
+    if (GNUNET_CONTAINER_bloomfilter_test (bfc, &tmp) == GNUNET_YES)
+      falseok++;
+  }
+  /* 2000 elements with 4 bits in 512k bits: expected rate well below 0.1% */
+  if (falseok > 10)
+  {
+    printf ("Blocked filter: %d false positives out of 10000\n", falseok);
+    GNUNET_CONTAINER_bloomfilter_free (bf);
+    GNUNET_CONTAINER_bloomfilter_free (bfc);
+    return 1;
+  }
+  bfo = GNUNET_CONTAINER_bloomfilter_init_blocked (NULL, SIZE, K);
+  if ( (GNUNET_OK != GNUNET_CONTAINER_bloomfilter_or2 (bfo, bfc)) ||
+       (GNUNET_OK != GNUNET_CONTAINER_bloomfilter_or2 (bfo, bf)) )
+    ok1 = 0;
+  GNUNET_CRYPTO_seed_weak_random (4);
+  for (i = 0; i < 2000; i++)
+  {
+    nextHC (&tmp);
+    if (GNUNET_CONTAINER_bloomfilter_test (bfo, &tmp) != GNUNET_YES)
+      ok1 = 0;
+  }
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+  GNUNET_CONTAINER_bloomfilter_free (bfc);
+  GNUNET_CONTAINER_bloomfilter_free (bfo);
+  GNUNET_break (0 == UNLINK (TESTFILE));
+  if (0 == ok1)
+  {
+    printf ("Blocked filter: or lost elements\n");
+    return 1;
+  }
+  return 0;
+}
+
+
+/**
+ * Test memory-mapped filters: the bits and counters must survive
+ * reloading, and files with other parameters must be rejected.
+ *
+ * @return 0 on success
+ */
+static int
+test_mapped ()
+{
+  struct GNUNET_CONTAINER_BloomFilter *bf;
+  struct GNUNET_HashCode tmp;
+  int i;
+  int ok;
+  struct stat sbuf;
+
+  if (0 == STAT (TESTFILE, &sbuf))
+    if (0 != UNLINK (TESTFILE))
+      GNUNET_log_strerror_file (GNUNET_ERROR_TYPE_ERROR, "unlink", TESTFILE);
+  bf = GNUNET_CONTAINER_bloomfilter_load_mapped (TESTFILE, SIZE, K, GNUNET_YES);
+  GNUNET_assert (NULL != bf);
+  GNUNET_CRYPTO_seed_weak_random (5);
+  for (i = 0; i < 200; i++)
+  {
+    nextHC (&tmp);
+    GNUNET_CONTAINER_bloomfilter_add (bf, &tmp);
+  }
+  GNUNET_CRYPTO_seed_weak_random (5);
+  for (i = 0; i < 100; i++)
+  {
+    nextHC (&tmp);
+    GNUNET_CONTAINER_bloomfilter_remove (bf, &tmp);
+  }
+  GNUNET_assert (GNUNET_OK == GNUNET_CONTAINER_bloomfilter_sync (bf));
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+
+  /* other parameters must be rejected */
+  GNUNET_assert (NULL ==
+                 GNUNET_CONTAINER_bloomfilter_load_mapped (TESTFILE, SIZE,
+                                                           K + 1, GNUNET_YES));
+  GNUNET_assert (NULL ==
+                 GNUNET_CONTAINER_bloomfilter_load_mapped (TESTFILE, SIZE,
+                                                           K, GNUNET_NO));
+  bf = GNUNET_CONTAINER_bloomfilter_load_mapped (TESTFILE, SIZE, K, GNUNET_YES);
+  GNUNET_assert (NULL != bf);
+  GNUNET_CRYPTO_seed_weak_random (5);
+  ok = 0;
+  for (i = 0; i < 200; i++)
+  {
+    nextHC (&tmp);
+    if (GNUNET_CONTAINER_bloomfilter_test (bf, &tmp) == GNUNET_YES)
+      ok++;
+  }
+  GNUNET_CONTAINER_bloomfilter_free (bf);
+  GNUNET_break (0 == UNLINK (TESTFILE));
+  /* removed elements may still show up as false positives */
+  if ( (ok < 100) || (ok > 110) )
+  {
+    printf ("Mapped filter: got %d elements after reloading, expected 100\n",
+            ok);
+    return 1;
+  }
+  return 0;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -239,5 +403,9 @@ main (int argc, char *argv[])
   GNUNET_CONTAINER_bloomfilter_free (bfi);
 
   GNUNET_break (0 == UNLINK (TESTFILE));
+  if (0 != test_blocked ())
+    return -1;
+  if (0 != test_mapped ())
+    return -1;
   return 0;
 }
@@ -279,11 +279,87 @@ check ()
 }
 
 
+/**
+ * Number of elements for #check_order().
+ */
+#define NUM_ELEMENTS 1000
+
+static struct GNUNET_CONTAINER_HeapNode *nodes[NUM_ELEMENTS];
+
+
+static int
+remove_odd_callback (void *cls, struct GNUNET_CONTAINER_HeapNode *node,
+                     void *element, GNUNET_CONTAINER_HeapCostType cost)
+{
+  unsigned int *seen = cls;
+  uintptr_t i = (uintptr_t) element;
+
+  (*seen)++;
+  if (1 == i % 2)
+  {
+    GNUNET_assert (element == GNUNET_CONTAINER_heap_remove_node (node));
+    nodes[i] = NULL;
+  }
+  return GNUNET_OK;
+}
+
+
+/**
+ * Check that elements come out in order after many cost
+ * updates and after removing nodes while iterating.
+ */
+static int
+check_order (enum GNUNET_CONTAINER_HeapOrder order)
+{
+  struct GNUNET_CONTAINER_Heap *heap;
+  GNUNET_CONTAINER_HeapCostType cost;
+  GNUNET_CONTAINER_HeapCostType last;
+  uintptr_t i;
+  unsigned int seen;
+  void *element;
+
+  heap = GNUNET_CONTAINER_heap_create (order);
+  for (i = 0; i < NUM_ELEMENTS; i++)
+    nodes[i] = GNUNET_CONTAINER_heap_insert (heap, (void *) i,
+                                             GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                                                       NUM_ELEMENTS));
+  for (i = 0; i < 10 * NUM_ELEMENTS; i++)
+  {
+    cost = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK, 100 * NUM_ELEMENTS);
+    GNUNET_CONTAINER_heap_update_cost (heap, nodes[i % NUM_ELEMENTS], cost);
+    GNUNET_assert (cost ==
+                   GNUNET_CONTAINER_heap_node_get_cost (nodes[i % NUM_ELEMENTS]));
+  }
+  seen = 0;
+  GNUNET_CONTAINER_heap_iterate (heap, &remove_odd_callback, &seen);
+  GNUNET_assert (NUM_ELEMENTS == seen);
+  GNUNET_assert (NUM_ELEMENTS / 2 == GNUNET_CONTAINER_heap_get_size (heap));
+  last = (GNUNET_CONTAINER_HEAP_ORDER_MIN == order) ? 0 : UINT64_MAX;
+  while (GNUNET_YES == GNUNET_CONTAINER_heap_peek2 (heap, &element, &cost))
+  {
+    GNUNET_assert (0 == (uintptr_t) element % 2);
+    if (GNUNET_CONTAINER_HEAP_ORDER_MIN == order)
+      GNUNET_assert (cost >= last);
+    else
+      GNUNET_assert (cost <= last);
+    last = cost;
+    GNUNET_assert (element == GNUNET_CONTAINER_heap_remove_root (heap));
+  }
+  GNUNET_assert (0 == GNUNET_CONTAINER_heap_get_size (heap));
+  GNUNET_CONTAINER_heap_destroy (heap);
+  return 0;
+}
+
+
 int
 main (int argc, char **argv)
 {
   GNUNET_log_setup ("test-container-heap", "WARNING", NULL);
-  return check ();
+  if (0 != check ())
+    return 1;
+  if (0 != check_order (GNUNET_CONTAINER_HEAP_ORDER_MIN))
+    return 1;
+  return check_order (GNUNET_CONTAINER_HEAP_ORDER_MAX);
 }
 
 /* end of test_container_heap.c */
@@ -103,6 +103,127 @@ testMap (int i)
   return 0;
 }
 
+
+/**
+ * Number of keys used by testRemoveWhileIterating().
+ */
+#define NUM_KEYS 10000
+
+static struct GNUNET_HashCode keys[NUM_KEYS];
+
+static unsigned int seen[NUM_KEYS];
+
+
+static int
+remove_other_and_self (void *cls,
+                       const struct GNUNET_HashCode *key,
+                       void *value)
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m = cls;
+  uintptr_t j = (uintptr_t) value;
+
+  seen[j]++;
+  GNUNET_assert (GNUNET_YES ==
+                 GNUNET_CONTAINER_multihashmap_remove (m, key, value));
+  /* also remove some entry we (most likely) have not seen yet */
+  if ( (0 == j % 3) &&
+       (j + 1 < NUM_KEYS) )
+    (void) GNUNET_CONTAINER_multihashmap_remove (m,
+                                                 &keys[j + 1],
+                                                 (void *) (j + 1));
+  return GNUNET_OK;
+}
+
+
+static int
+testRemoveWhileIterating ()
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m;
+  uintptr_t j;
+  int ret;
+
+  m = GNUNET_CONTAINER_multihashmap_create (16, GNUNET_NO);
+  for (j = 0; j < NUM_KEYS; j++)
+  {
+    GNUNET_CRYPTO_hash (&j, sizeof (j), &keys[j]);
+    CHECK (GNUNET_OK ==
+           GNUNET_CONTAINER_multihashmap_put (m, &keys[j], (void *) j,
+                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  }
+  CHECK (NUM_KEYS == GNUNET_CONTAINER_multihashmap_size (m));
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK ((void *) j == GNUNET_CONTAINER_multihashmap_get (m, &keys[j]));
+  memset (seen, 0, sizeof (seen));
+  ret = GNUNET_CONTAINER_multihashmap_iterate (m,
+                                               &remove_other_and_self,
+                                               m);
+  CHECK (0 == GNUNET_CONTAINER_multihashmap_size (m));
+  /* every entry was seen at most once, and all were removed */
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK (seen[j] <= 1);
+  CHECK (ret <= NUM_KEYS);
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK (GNUNET_NO == GNUNET_CONTAINER_multihashmap_contains (m, &keys[j]));
+  /* the map must be fully usable after the iteration */
+  for (j = 0; j < NUM_KEYS; j += 2)
+    CHECK (GNUNET_OK ==
+           GNUNET_CONTAINER_multihashmap_put (m, &keys[j], (void *) j,
+                                              GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK ( (0 == j % 2) ==
+            GNUNET_CONTAINER_multihashmap_contains (m, &keys[j]));
+  for (j = 0; j < NUM_KEYS; j += 4)
+    CHECK (GNUNET_YES ==
+           GNUNET_CONTAINER_multihashmap_remove (m, &keys[j], (void *) j));
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK ( (2 == j % 4) ==
+            GNUNET_CONTAINER_multihashmap_contains (m, &keys[j]));
+  CHECK (NUM_KEYS / 4 == GNUNET_CONTAINER_multihashmap_clear (m));
+  CHECK (0 == GNUNET_CONTAINER_multihashmap_iterate (m, NULL, NULL));
+  GNUNET_CONTAINER_multihashmap_destroy (m);
+  return 0;
+}
+
+
+static int
+testBatch ()
+{
+  struct GNUNET_CONTAINER_MultiHashMap *m;
+  void *values[NUM_KEYS];
+  void *found[NUM_KEYS];
+  uintptr_t j;
+
+  m = GNUNET_CONTAINER_multihashmap_create (1, GNUNET_NO);
+  GNUNET_CONTAINER_multihashmap_reserve (m, NUM_KEYS);
+  for (j = 0; j < NUM_KEYS; j++)
+  {
+    GNUNET_CRYPTO_hash (&j, sizeof (j), &keys[j]);
+    values[j] = (void *) (j + 1);
+  }
+  CHECK (NUM_KEYS / 2 ==
+         GNUNET_CONTAINER_multihashmap_put_multiple (m, keys, values,
+                                                     NUM_KEYS / 2,
+                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  /* the first half is rejected, the second half added */
+  CHECK (NUM_KEYS / 2 ==
+         GNUNET_CONTAINER_multihashmap_put_multiple (m, keys, values,
+                                                     NUM_KEYS,
+                                                     GNUNET_CONTAINER_MULTIHASHMAPOPTION_UNIQUE_ONLY));
+  CHECK (NUM_KEYS == GNUNET_CONTAINER_multihashmap_size (m));
+  CHECK (NUM_KEYS ==
+         GNUNET_CONTAINER_multihashmap_get_many (m, keys, found, NUM_KEYS));
+  for (j = 0; j < NUM_KEYS; j++)
+    CHECK (found[j] == values[j]);
+  CHECK (GNUNET_YES ==
+         GNUNET_CONTAINER_multihashmap_remove (m, &keys[7], values[7]));
+  CHECK (NUM_KEYS - 1 ==
+         GNUNET_CONTAINER_multihashmap_get_many (m, keys, found, NUM_KEYS));
+  CHECK (NULL == found[7]);
+  GNUNET_CONTAINER_multihashmap_destroy (m);
+  return 0;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -112,6 +233,8 @@ main (int argc, char *argv[])
   GNUNET_log_setup ("test-container-multihashmap", "WARNING", NULL);
   for (i = 1; i < 255; i++)
     failureCount += testMap (i);
+  failureCount += testRemoveWhileIterating ();
+  failureCount += testBatch ();
   if (failureCount != 0)
     return 1;
   return 0;
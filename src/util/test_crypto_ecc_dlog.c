@@ -163,6 +163,87 @@ test_math (struct GNUNET_CRYPTO_EccDlogContext *edc)
   fprintf (stderr, "\n");
 }
 
+/**
+ * Test conversion of points to their binary representation
+ * and back, and multiplication of points.
+ *
+ * @param edc context for ECC operations
+ */
+static void
+test_bin (struct GNUNET_CRYPTO_EccDlogContext *edc)
+{
+  struct GNUNET_CRYPTO_EccPoint bin;
+  gcry_mpi_point_t ip;
+  gcry_mpi_point_t ip2;
+  gcry_mpi_point_t prod;
+  gcry_mpi_t fact;
+  int i;
+
+  fact = gcry_mpi_new (0);
+  gcry_mpi_sub_ui (fact, fact, 3);
+  for (i=-MATH_MAX;i<MATH_MAX;i++)
+  {
+    fprintf (stderr, ".");
+    ip = GNUNET_CRYPTO_ecc_dexp (edc, i);
+    GNUNET_CRYPTO_ecc_point_to_bin (edc, ip, &bin);
+    ip2 = GNUNET_CRYPTO_ecc_bin_to_point (edc, &bin);
+    GNUNET_assert (NULL != ip2);
+    GNUNET_assert (i ==
+		   GNUNET_CRYPTO_ecc_dlog (edc,
+					   ip2));
+    prod = GNUNET_CRYPTO_ecc_pmul_mpi (edc, ip2, fact);
+    GNUNET_assert (-3 * i ==
+		   GNUNET_CRYPTO_ecc_dlog (edc,
+					   prod));
+    GNUNET_CRYPTO_ecc_free (ip);
+    GNUNET_CRYPTO_ecc_free (ip2);
+    GNUNET_CRYPTO_ecc_free (prod);
+  }
+  gcry_mpi_release (fact);
+  fprintf (stderr, "\n");
+}
+
+
+/**
+ * Write the table of @a edc to a file, load it again and
+ * check that dlog works with the loaded table.
+ *
+ * @param edc context created with #GNUNET_CRYPTO_ecc_dlog_prepare()
+ */
+static void
+test_table (struct GNUNET_CRYPTO_EccDlogContext *edc)
+{
+  struct GNUNET_CRYPTO_EccDlogContext *loaded;
+  gcry_mpi_point_t ip;
+  char *fn;
+  int i;
+
+  fn = GNUNET_DISK_mktemp ("test-crypto-ecc-dlog");
+  GNUNET_assert (NULL != fn);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CRYPTO_ecc_dlog_write (edc,
+                                               fn));
+  /* parameters must match */
+  GNUNET_assert (NULL ==
+                 GNUNET_CRYPTO_ecc_dlog_load (fn,
+                                              MAX_FACT,
+                                              MAX_MEM + 1));
+  loaded = GNUNET_CRYPTO_ecc_dlog_load (fn,
+                                        MAX_FACT,
+                                        MAX_MEM);
+  GNUNET_assert (NULL != loaded);
+  for (i=-MAX_FACT;i<=MAX_FACT;i++)
+  {
+    ip = GNUNET_CRYPTO_ecc_dexp (loaded, i);
+    GNUNET_assert (i ==
+		   GNUNET_CRYPTO_ecc_dlog (loaded,
+					   ip));
+    GNUNET_CRYPTO_ecc_free (ip);
+  }
+  GNUNET_CRYPTO_ecc_dlog_release (loaded);
+  GNUNET_break (0 == UNLINK (fn));
+  GNUNET_free (fn);
+}
 
 
 int
@@ -187,6 +268,8 @@ main (int argc, char *argv[])
 					MAX_MEM);
   test_dlog (edc);
   test_math (edc);
+  test_bin (edc);
+  test_table (edc);
   GNUNET_CRYPTO_ecc_dlog_release (edc);
   return 0;
 }
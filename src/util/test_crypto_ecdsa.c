@@ -138,6 +138,36 @@ testDeriveSignVerify ()
 }
 
 
+static int
+testDeriveContext ()
+{
+  struct GNUNET_CRYPTO_EcdsaDeriveContext *dc;
+  struct GNUNET_CRYPTO_EcdsaPublicKey pkey;
+  struct GNUNET_CRYPTO_EcdsaPublicKey dpub;
+  struct GNUNET_CRYPTO_EcdsaPublicKey dcpub;
+  static const char *labels[] = { "test-derive", "www", "", "+" };
+  unsigned int i;
+  int ret;
+
+  GNUNET_CRYPTO_ecdsa_key_get_public (key, &pkey);
+  dc = GNUNET_CRYPTO_ecdsa_derive_context_create (&pkey, "test-CTX");
+  ret = GNUNET_OK;
+  for (i=0;i<sizeof (labels) / sizeof (labels[0]);i++)
+  {
+    GNUNET_CRYPTO_ecdsa_public_key_derive (&pkey, labels[i], "test-CTX", &dpub);
+    GNUNET_CRYPTO_ecdsa_derive_context_public_key (dc, labels[i], &dcpub);
+    if (0 != memcmp (&dpub, &dcpub, sizeof (dpub)))
+    {
+      printf ("Derivation context result differs for label `%s'!\n",
+              labels[i]);
+      ret = GNUNET_SYSERR;
+    }
+  }
+  GNUNET_CRYPTO_ecdsa_derive_context_destroy (dc);
+  return ret;
+}
+
+
 #if PERF
 static int
 testSignPerformance ()
@@ -226,6 +256,8 @@ main (int argc, char *argv[])
 #endif
   if (GNUNET_OK != testSignVerify ())
     failure_count++;
+  if (GNUNET_OK != testDeriveContext ())
+    failure_count++;
   GNUNET_free (key);
   perf_keygen ();
 
@@ -99,6 +99,43 @@ testArithmetic ()
   return 0;
 }
 
+/**
+ * Number of blocks for #testHashMany().
+ */
+#define MANY 64
+
+static int
+testHashMany ()
+{
+  static char data[MANY * 4096];
+  const void *blocks[MANY];
+  size_t sizes[MANY];
+  struct GNUNET_HashCode hc[MANY];
+  struct GNUNET_HashCode want;
+  unsigned int n;
+  unsigned int i;
+
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK, data, sizeof (data));
+  for (i = 0; i < MANY; i++)
+  {
+    blocks[i] = &data[i * 4096];
+    sizes[i] = (i * 1337) % 4097;
+  }
+  /* small batches stay in this thread, the full one uses threads */
+  for (n = 0; n <= MANY; n += MANY / 4)
+  {
+    GNUNET_CRYPTO_hash_many (blocks, sizes, n, hc);
+    for (i = 0; i < n; i++)
+    {
+      GNUNET_CRYPTO_hash (blocks[i], sizes[i], &want);
+      if (0 != memcmp (&want, &hc[i], sizeof (want)))
+        return 1;
+    }
+  }
+  return 0;
+}
+
+
 static void
 finished_task (void *cls, const struct GNUNET_HashCode * res)
 {
@@ -122,6 +159,22 @@ file_hasher (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
 }
 
 
+static void
+file_hasher_offload (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_CRYPTO_FileHashContext *fhc;
+
+  /* cancelling must be possible while a worker may be hashing */
+  fhc = GNUNET_CRYPTO_hash_file_offload (FILENAME, 1024,
+                                         &finished_task, NULL);
+  GNUNET_assert (NULL != fhc);
+  GNUNET_CRYPTO_hash_file_cancel (fhc);
+  GNUNET_assert (NULL !=
+                 GNUNET_CRYPTO_hash_file_offload (FILENAME, 1024,
+                                                  &finished_task, cls));
+}
+
+
 static int
 testFileHash ()
 {
@@ -135,6 +188,11 @@ testFileHash ()
   GNUNET_break (0 == FCLOSE (f));
   ret = 1;
   GNUNET_SCHEDULER_run (&file_hasher, &ret);
+  if (0 == ret)
+  {
+    ret = 1;
+    GNUNET_SCHEDULER_run (&file_hasher_offload, &ret);
+  }
   GNUNET_break (0 == UNLINK (FILENAME));
   return ret;
 }
@@ -150,6 +208,7 @@ main (int argc, char *argv[])
   for (i = 0; i < 10; i++)
     failureCount += testEncoding ();
   failureCount += testArithmetic ();
+  failureCount += testHashMany ();
   failureCount += testFileHash ();
   if (failureCount != 0)
     return 1;
@@ -0,0 +1,159 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+
+*/
+/**
+ * @file util/test_crypto_offload.c
+ * @brief testcase for the crypto offload pool
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+#include "gnunet_signatures.h"
+
+/**
+ * Number of verifications we run concurrently.
+ */
+#define ITER 25
+
+static struct GNUNET_CRYPTO_EddsaPrivateKey *key;
+
+static struct GNUNET_CRYPTO_EddsaPublicKey pkey;
+
+static struct GNUNET_CRYPTO_EccSignaturePurpose purp;
+
+static struct GNUNET_CRYPTO_EddsaSignature sig;
+
+static struct GNUNET_CRYPTO_EcdhePrivateKey *ecdhe[2];
+
+static struct GNUNET_HashCode ecdh_result;
+
+static unsigned int pending;
+
+static int ecdh_seen;
+
+
+static void
+verified_good (void *cls,
+               int result)
+{
+  GNUNET_assert (GNUNET_OK == result);
+  pending--;
+}
+
+
+static void
+verified_bad (void *cls,
+              int result)
+{
+  GNUNET_assert (GNUNET_SYSERR == result);
+  pending--;
+}
+
+
+static void
+never_called (void *cls,
+              int result)
+{
+  GNUNET_assert (0);
+}
+
+
+static void
+ecdh_done (void *cls,
+           const struct GNUNET_HashCode *key_material)
+{
+  GNUNET_assert (NULL != key_material);
+  GNUNET_assert (0 == memcmp (key_material,
+                              &ecdh_result,
+                              sizeof (struct GNUNET_HashCode)));
+  pending--;
+  ecdh_seen = GNUNET_YES;
+}
+
+
+static void
+signed_cb (void *cls,
+           const struct GNUNET_CRYPTO_EddsaSignature *s)
+{
+  struct GNUNET_CRYPTO_EcdhePublicKey pub;
+  struct GNUNET_CRYPTO_OffloadJob *jobs[ITER];
+  unsigned int i;
+
+  GNUNET_assert (NULL != s);
+  sig = *s;
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CRYPTO_eddsa_verify (GNUNET_SIGNATURE_PURPOSE_TEST,
+                                             &purp, &sig, &pkey));
+  for (i = 0; i < ITER; i++)
+  {
+    pending++;
+    GNUNET_CRYPTO_eddsa_verify_offload (GNUNET_SIGNATURE_PURPOSE_TEST,
+                                        &purp, &sig, &pkey,
+                                        &verified_good, NULL);
+    pending++;
+    GNUNET_CRYPTO_eddsa_verify_offload (GNUNET_SIGNATURE_PURPOSE_TRANSPORT_PONG_OWN,
+                                        &purp, &sig, &pkey,
+                                        &verified_bad, NULL);
+  }
+  /* cancelled jobs must not call their continuation, whatever state
+     they are in */
+  for (i = 0; i < ITER; i++)
+    jobs[i] = GNUNET_CRYPTO_eddsa_verify_offload (GNUNET_SIGNATURE_PURPOSE_TEST,
+                                                  &purp, &sig, &pkey,
+                                                  &never_called, NULL);
+  for (i = 0; i < ITER; i++)
+    GNUNET_CRYPTO_offload_cancel (jobs[i]);
+  GNUNET_CRYPTO_ecdhe_key_get_public (ecdhe[1], &pub);
+  GNUNET_assert (GNUNET_OK ==
+                 GNUNET_CRYPTO_ecc_ecdh (ecdhe[0], &pub, &ecdh_result));
+  pending++;
+  GNUNET_CRYPTO_ecc_ecdh_offload (ecdhe[0], &pub,
+                                  &ecdh_done, NULL);
+}
+
+
+static void
+run (void *cls,
+     const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  GNUNET_CRYPTO_eddsa_sign_offload (key, &purp,
+                                    &signed_cb, NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GNUNET_log_setup ("test-crypto-offload", "WARNING", NULL);
+  key = GNUNET_CRYPTO_eddsa_key_create ();
+  GNUNET_CRYPTO_eddsa_key_get_public (key, &pkey);
+  ecdhe[0] = GNUNET_CRYPTO_ecdhe_key_create ();
+  ecdhe[1] = GNUNET_CRYPTO_ecdhe_key_create ();
+  purp.size = htonl (sizeof (struct GNUNET_CRYPTO_EccSignaturePurpose));
+  purp.purpose = htonl (GNUNET_SIGNATURE_PURPOSE_TEST);
+  /* the scheduler only terminates once all jobs are done */
+  GNUNET_SCHEDULER_run (&run, NULL);
+  GNUNET_free (key);
+  GNUNET_free (ecdhe[0]);
+  GNUNET_free (ecdhe[1]);
+  return ( (0 == pending) &&
+           (GNUNET_YES == ecdh_seen) ) ? 0 : 1;
+}
+
+/* end of test_crypto_offload.c */
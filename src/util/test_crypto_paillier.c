@@ -209,6 +209,73 @@ test_hom ()
 }
 
 
+/**
+ * Number of plaintexts used by #test_batch().
+ */
+#define BATCH_SIZE 5
+
+
+static int
+test_batch ()
+{
+  gcry_mpi_t plaintexts[BATCH_SIZE];
+  gcry_mpi_t results[BATCH_SIZE];
+  struct GNUNET_CRYPTO_PaillierCiphertext ciphertexts[BATCH_SIZE];
+  struct GNUNET_CRYPTO_PaillierPublicKey public_key;
+  struct GNUNET_CRYPTO_PaillierPrivateKey private_key;
+  unsigned int i;
+  unsigned int round;
+  int ret;
+
+  ret = 0;
+  GNUNET_CRYPTO_paillier_create (&public_key,
+                                 &private_key);
+  for (i=0;i<BATCH_SIZE;i++)
+  {
+    GNUNET_assert (NULL != (plaintexts[i] = gcry_mpi_new (0)));
+    GNUNET_assert (NULL != (results[i] = gcry_mpi_new (0)));
+    gcry_mpi_randomize (plaintexts[i],
+                        GNUNET_CRYPTO_PAILLIER_BITS / 2,
+                        GCRY_WEAK_RANDOM);
+  }
+  GNUNET_assert (0 <=
+                 GNUNET_CRYPTO_paillier_encrypt_batch (&public_key,
+                                                       NULL,
+                                                       plaintexts,
+                                                       BATCH_SIZE,
+                                                       2,
+                                                       ciphertexts));
+  /* first round decrypts using the CRT, the second one without
+     the prime factors of n */
+  for (round=0;round<2;round++)
+  {
+    GNUNET_CRYPTO_paillier_decrypt_batch (&private_key,
+                                          &public_key,
+                                          ciphertexts,
+                                          BATCH_SIZE,
+                                          results);
+    for (i=0;i<BATCH_SIZE;i++)
+      if (0 != gcry_mpi_cmp (plaintexts[i],
+                             results[i]))
+      {
+        fprintf (stderr,
+                 "Paillier batch decryption failed at %u in round %u\n",
+                 i,
+                 round);
+        ret = 1;
+      }
+    memset (private_key.p, 0, sizeof (private_key.p));
+    memset (private_key.q, 0, sizeof (private_key.q));
+  }
+  for (i=0;i<BATCH_SIZE;i++)
+  {
+    gcry_mpi_release (plaintexts[i]);
+    gcry_mpi_release (results[i]);
+  }
+  return ret;
+}
+
+
 int
 main (int argc,
       char *argv[])
@@ -224,6 +291,9 @@ main (int argc,
   if (0 != ret)
     return ret;
   ret = test_hom ();
+  if (0 != ret)
+    return ret;
+  ret = test_batch ();
   return ret;
 }
 
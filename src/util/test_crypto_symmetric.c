@@ -68,6 +68,120 @@ testSymcipher ()
 }
 
 
+static int
+testSymcipherContext ()
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey key[2];
+  struct GNUNET_CRYPTO_SymmetricContext *ctx;
+  const struct GNUNET_CRYPTO_SymmetricInitializationVector *iv;
+  char plain[1024];
+  char expect[sizeof (plain)];
+  char result[sizeof (plain)];
+  unsigned int i;
+  int ret;
+
+  ret = 0;
+  iv = (const struct GNUNET_CRYPTO_SymmetricInitializationVector *) INITVALUE;
+  GNUNET_CRYPTO_symmetric_create_session_key (&key[0]);
+  GNUNET_CRYPTO_symmetric_create_session_key (&key[1]);
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              plain, sizeof (plain));
+  ctx = GNUNET_CRYPTO_symmetric_context_create (&key[0]);
+  for (i = 0; i < 4; i++)
+  {
+    /* alternate keys to exercise rekeying, repeat to exercise reuse */
+    GNUNET_CRYPTO_symmetric_context_set_key (ctx, &key[i / 2]);
+    GNUNET_CRYPTO_symmetric_encrypt (plain, sizeof (plain),
+                                     &key[i / 2], iv, expect);
+    if (sizeof (plain) !=
+        GNUNET_CRYPTO_symmetric_context_encrypt (ctx, plain, sizeof (plain),
+                                                 iv, result))
+      ret = 1;
+    if (0 != memcmp (expect, result, sizeof (plain)))
+    {
+      printf ("symciphertest failed: context encryption differs\n");
+      ret = 1;
+    }
+    /* decrypt in place */
+    if (sizeof (plain) !=
+        GNUNET_CRYPTO_symmetric_context_decrypt (ctx, result, sizeof (plain),
+                                                 iv, result))
+      ret = 1;
+    if (0 != memcmp (plain, result, sizeof (plain)))
+    {
+      printf ("symciphertest failed: context decryption differs\n");
+      ret = 1;
+    }
+  }
+  GNUNET_CRYPTO_symmetric_context_destroy (ctx);
+  return ret;
+}
+
+
+static int
+testAead ()
+{
+  struct GNUNET_CRYPTO_SymmetricSessionKey key;
+  struct GNUNET_CRYPTO_AeadContext *ctx;
+  char nonce[GNUNET_CRYPTO_AEAD_NONCE_LENGTH];
+  char tag[GNUNET_CRYPTO_AEAD_TAG_LENGTH];
+  char aad[16];
+  char plain[1024];
+  char buf[sizeof (plain)];
+  int ret;
+
+  ret = 0;
+  GNUNET_CRYPTO_symmetric_create_session_key (&key);
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              plain, sizeof (plain));
+  GNUNET_CRYPTO_random_block (GNUNET_CRYPTO_QUALITY_WEAK,
+                              nonce, sizeof (nonce));
+  memset (aad, 42, sizeof (aad));
+  ctx = GNUNET_CRYPTO_aead_context_create (&key);
+  memcpy (buf, plain, sizeof (plain));
+  GNUNET_CRYPTO_aead_encrypt (ctx, nonce, aad, sizeof (aad),
+                              buf, sizeof (buf), tag);
+  if (0 == memcmp (buf, plain, sizeof (plain)))
+  {
+    printf ("aeadtest failed: block not encrypted\n");
+    ret = 1;
+  }
+  if ( (GNUNET_OK !=
+        GNUNET_CRYPTO_aead_decrypt (ctx, nonce, aad, sizeof (aad),
+                                    buf, sizeof (buf), tag)) ||
+       (0 != memcmp (buf, plain, sizeof (plain))) )
+  {
+    printf ("aeadtest failed: decryption differs\n");
+    ret = 1;
+  }
+  /* flipping a ciphertext bit must be detected */
+  GNUNET_CRYPTO_aead_encrypt (ctx, nonce, aad, sizeof (aad),
+                              buf, sizeof (buf), tag);
+  buf[17] ^= 1;
+  if (GNUNET_SYSERR !=
+      GNUNET_CRYPTO_aead_decrypt (ctx, nonce, aad, sizeof (aad),
+                                  buf, sizeof (buf), tag))
+  {
+    printf ("aeadtest failed: modified ciphertext accepted\n");
+    ret = 1;
+  }
+  /* so must a modified AAD */
+  memcpy (buf, plain, sizeof (plain));
+  GNUNET_CRYPTO_aead_encrypt (ctx, nonce, aad, sizeof (aad),
+                              buf, sizeof (buf), tag);
+  aad[3] ^= 1;
+  if (GNUNET_SYSERR !=
+      GNUNET_CRYPTO_aead_decrypt (ctx, nonce, aad, sizeof (aad),
+                                  buf, sizeof (buf), tag))
+  {
+    printf ("aeadtest failed: modified AAD accepted\n");
+    ret = 1;
+  }
+  GNUNET_CRYPTO_aead_context_destroy (ctx);
+  return ret;
+}
+
+
 static int
 verifyCrypto ()
 {
@@ -158,6 +272,8 @@ main (int argc, char *argv[])
   GNUNET_assert (strlen (INITVALUE) >
                  sizeof (struct GNUNET_CRYPTO_SymmetricInitializationVector));
   failureCount += testSymcipher ();
+  failureCount += testSymcipherContext ();
+  failureCount += testAead ();
   failureCount += verifyCrypto ();
 
   if (failureCount != 0)
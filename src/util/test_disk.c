@@ -217,6 +217,84 @@ testDirMani ()
 }
 
 
+static struct GNUNET_DISK_FileHandle *async_fh;
+
+static char async_buf[100];
+
+static int async_ret;
+
+
+static void
+async_never (void *cls, ssize_t size)
+{
+  GNUNET_assert (0);
+}
+
+
+static void
+async_read_done (void *cls, ssize_t size)
+{
+  /* read past the end comes up short */
+  if ( (strlen (TESTSTRING) - 2 == size) &&
+       (0 == memcmp (async_buf, &TESTSTRING[2], size)) )
+    async_ret = 0;
+  GNUNET_break (GNUNET_OK == GNUNET_DISK_file_close (async_fh));
+}
+
+
+static void
+async_sync_done (void *cls, ssize_t size)
+{
+  if (0 != size)
+    return;
+  memset (async_buf, 0, sizeof (async_buf));
+  GNUNET_assert (NULL !=
+                 GNUNET_DISK_file_read_async (async_fh, async_buf,
+                                              sizeof (async_buf), 2,
+                                              &async_read_done, NULL));
+}
+
+
+static void
+async_write_done (void *cls, ssize_t size)
+{
+  if (strlen (TESTSTRING) != size)
+    return;
+  GNUNET_assert (NULL !=
+                 GNUNET_DISK_file_sync_async (async_fh,
+                                              &async_sync_done, NULL));
+}
+
+
+static void
+async_run (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  async_fh = GNUNET_DISK_file_open (".testfile",
+                                    GNUNET_DISK_OPEN_READWRITE |
+                                    GNUNET_DISK_OPEN_CREATE,
+                                    GNUNET_DISK_PERM_USER_READ |
+                                    GNUNET_DISK_PERM_USER_WRITE);
+  GNUNET_assert (NULL != async_fh);
+  GNUNET_DISK_async_cancel (GNUNET_DISK_file_read_async (async_fh, async_buf,
+                                                         sizeof (async_buf), 0,
+                                                         &async_never, NULL));
+  GNUNET_assert (NULL !=
+                 GNUNET_DISK_file_write_async (async_fh, TESTSTRING,
+                                               strlen (TESTSTRING), 0,
+                                               &async_write_done, NULL));
+}
+
+
+static int
+testAsync ()
+{
+  async_ret = 1;
+  GNUNET_SCHEDULER_run (&async_run, NULL);
+  GNUNET_break (0 == UNLINK (".testfile"));
+  return async_ret;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -230,6 +308,7 @@ main (int argc, char *argv[])
   failureCount += testCanonicalize ();
   failureCount += testChangeOwner ();
   failureCount += testDirMani ();
+  failureCount += testAsync ();
   if (failureCount != 0)
   {
     FPRINTF (stderr, "\n%u TESTS FAILED!\n", failureCount);
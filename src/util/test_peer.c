@@ -97,6 +97,10 @@ check ()
   GNUNET_PEER_resolve (1, &res);
   GNUNET_assert (0 == memcmp (&res, &pidArr[0], sizeof (res)));
 
+  /* the cached short form must match GNUNET_i2s */
+  GNUNET_assert (0 == strcmp (GNUNET_PEER_i2s (1),
+                              GNUNET_i2s (&pidArr[0])));
+
   /*
    * Attempt to convert pid = 0 (which is reserved)
    * into a peer identity object, the peer identity memory
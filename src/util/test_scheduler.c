@@ -230,6 +230,154 @@ checkCancel ()
 }
 
 
+/**
+ * Number of delayed tasks scheduled by #taskWheelStart().
+ */
+#define WHEEL_TASKS 1000
+
+static struct GNUNET_SCHEDULER_Task *wheel_tasks[WHEEL_TASKS];
+
+static struct GNUNET_TIME_Absolute wheel_due[WHEEL_TASKS];
+
+static unsigned int wheel_left;
+
+
+static void
+taskWheel (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  unsigned int i = (unsigned int) (uintptr_t) cls;
+
+  GNUNET_assert (0 != (tc->reason & GNUNET_SCHEDULER_REASON_TIMEOUT));
+  GNUNET_assert (0 ==
+                 GNUNET_TIME_absolute_get_remaining (wheel_due[i]).rel_value_us);
+  wheel_tasks[i] = NULL;
+  wheel_left--;
+}
+
+
+static void
+taskSkew (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  /* make the tasks that are minutes away due now */
+  GNUNET_TIME_set_offset (GNUNET_TIME_get_offset ()
+                          + GNUNET_TIME_UNIT_HOURS.rel_value_us);
+}
+
+
+static void
+taskWheelStart (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_TIME_Relative delay;
+  unsigned int i;
+
+  for (i = 0; i < WHEEL_TASKS; i++)
+  {
+    if (0 == i % 10)
+      delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MINUTES,
+                                             1 + i % 50);
+    else
+      delay = GNUNET_TIME_relative_multiply (GNUNET_TIME_UNIT_MILLISECONDS,
+                                             1 + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                                                           500));
+    wheel_due[i] = GNUNET_TIME_relative_to_absolute (delay);
+    wheel_tasks[i] = GNUNET_SCHEDULER_add_delayed (delay,
+                                                   &taskWheel,
+                                                   (void *) (uintptr_t) i);
+    wheel_left++;
+  }
+  for (i = 0; i < WHEEL_TASKS; i += 3)
+  {
+    GNUNET_SCHEDULER_cancel (wheel_tasks[i]);
+    wheel_tasks[i] = NULL;
+    wheel_left--;
+  }
+  GNUNET_SCHEDULER_add_delayed (GNUNET_TIME_UNIT_SECONDS,
+                                &taskSkew,
+                                NULL);
+}
+
+
+/**
+ * Schedule many delayed tasks, cancel some of them and check that
+ * the others run, and not before they are due.
+ *
+ * @param use_wheel whether to use the timer wheel
+ */
+static int
+checkWheel (int use_wheel)
+{
+  long long offset;
+
+  offset = GNUNET_TIME_get_offset ();
+  wheel_left = 0;
+  GNUNET_SCHEDULER_set_timer_wheel (use_wheel);
+  GNUNET_SCHEDULER_run (&taskWheelStart, NULL);
+  GNUNET_SCHEDULER_set_timer_wheel (GNUNET_YES);
+  GNUNET_TIME_set_offset (offset);
+  return (0 == wheel_left) ? 0 : 1;
+}
+
+
+static void
+taskBusy (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct GNUNET_TIME_Absolute end;
+
+  end = GNUNET_TIME_relative_to_absolute (GNUNET_TIME_relative_multiply
+                                          (GNUNET_TIME_UNIT_MILLISECONDS, 2));
+  while (0 != GNUNET_TIME_absolute_get_remaining (end).rel_value_us)
+    ;
+}
+
+
+static void
+taskProfileCheck (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  int *ok = cls;
+  const struct GNUNET_SCHEDULER_Profile *profile;
+
+  profile = GNUNET_SCHEDULER_get_profile ();
+  GNUNET_assert (NULL != profile);
+  GNUNET_assert (0 < profile->slowest_count);
+  GNUNET_assert (&taskBusy == profile->slowest[0].callback);
+  GNUNET_assert (GNUNET_SCHEDULER_PRIORITY_DEFAULT == profile->slowest[0].priority);
+  GNUNET_assert (2000 <= profile->slowest[0].duration.rel_value_us);
+  /* 2 ms fall into the "1 ms to 10 ms" bucket, unless we were preempted */
+  GNUNET_assert (1 <=
+                 profile->duration[GNUNET_SCHEDULER_PRIORITY_DEFAULT][2] +
+                 profile->duration[GNUNET_SCHEDULER_PRIORITY_DEFAULT][3] +
+                 profile->duration[GNUNET_SCHEDULER_PRIORITY_DEFAULT][4] +
+                 profile->duration[GNUNET_SCHEDULER_PRIORITY_DEFAULT][5]);
+  GNUNET_SCHEDULER_set_profiling (GNUNET_NO);
+  GNUNET_assert (NULL == GNUNET_SCHEDULER_get_profile ());
+  *ok = 0;
+}
+
+
+static void
+taskProfile (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  GNUNET_SCHEDULER_set_profiling (GNUNET_YES);
+  GNUNET_SCHEDULER_add_now (&taskBusy, NULL);
+  GNUNET_SCHEDULER_add_with_priority (GNUNET_SCHEDULER_PRIORITY_IDLE,
+                                      &taskProfileCheck, cls);
+}
+
+
+/**
+ * Check that the per-task accounting identifies a slow task.
+ */
+static int
+checkProfile ()
+{
+  int ok;
+
+  ok = 1;
+  GNUNET_SCHEDULER_run (&taskProfile, &ok);
+  return ok;
+}
+
+
 int
 main (int argc, char *argv[])
 {
@@ -242,6 +390,9 @@ main (int argc, char *argv[])
 #endif
   ret += checkShutdown ();
   ret += checkCancel ();
+  ret += checkWheel (GNUNET_YES);
+  ret += checkWheel (GNUNET_NO);
+  ret += checkProfile ();
   GNUNET_DISK_pipe_close (p);
 
   return ret;
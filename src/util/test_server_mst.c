@@ -0,0 +1,125 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2016 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_server_mst.c
+ * @brief test for in-place message tokenizing in server_mst.c
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+/**
+ * Number of messages we feed into the tokenizer.
+ */
+#define NUM_MSGS 1000
+
+/**
+ * Number of messages received so far.
+ */
+static unsigned int received;
+
+
+/**
+ * Check that we get the messages in order with the right
+ * content and properly aligned.
+ */
+static int
+mst_cb (void *cls, void *client,
+        const struct GNUNET_MessageHeader *message)
+{
+  const char *payload = (const char *) &message[1];
+  uint16_t size = ntohs (message->size);
+  uint16_t i;
+
+  GNUNET_assert (0 == ((uintptr_t) message) % sizeof (uint32_t));
+  GNUNET_assert (received == ntohs (message->type));
+  GNUNET_assert (sizeof (struct GNUNET_MessageHeader) + received % 77 == size);
+  for (i = 0; i < size - sizeof (struct GNUNET_MessageHeader); i++)
+    GNUNET_assert ((char) (received + i) == payload[i]);
+  received++;
+  return GNUNET_OK;
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  struct GNUNET_SERVER_MessageStreamTokenizer *mst;
+  struct GNUNET_MessageHeader hdr;
+  char *stream;
+  char *buf;
+  size_t len;
+  size_t off;
+  size_t size;
+  size_t chunk;
+  unsigned int i;
+  uint16_t j;
+
+  GNUNET_log_setup ("test_server_mst", "WARNING", NULL);
+  /* build a stream of messages of odd sizes */
+  stream = GNUNET_malloc (NUM_MSGS *
+                          (sizeof (struct GNUNET_MessageHeader) + 77));
+  len = 0;
+  for (i = 0; i < NUM_MSGS; i++)
+  {
+    hdr.size = htons (sizeof (struct GNUNET_MessageHeader) + i % 77);
+    hdr.type = htons (i);
+    memcpy (&stream[len], &hdr, sizeof (hdr));
+    len += sizeof (hdr);
+    for (j = 0; j < i % 77; j++)
+      stream[len++] = (char) (i + j);
+  }
+  /* feed it in chunks of varying size, reading in place */
+  mst = GNUNET_SERVER_mst_create (&mst_cb, NULL);
+  off = 0;
+  while (off < len)
+  {
+    buf = GNUNET_SERVER_mst_get_buffer (mst, &size);
+    chunk = 1 + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                          300);
+    chunk = GNUNET_MIN (GNUNET_MIN (size, len - off),
+                        chunk);
+    memcpy (buf, &stream[off], chunk);
+    off += chunk;
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_SERVER_mst_receive_buffer (mst, NULL, chunk,
+                                                     GNUNET_NO, GNUNET_NO));
+  }
+  GNUNET_assert (NUM_MSGS == received);
+  /* and the same with copying */
+  received = 0;
+  off = 0;
+  while (off < len)
+  {
+    chunk = 1 + GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                          300);
+    chunk = GNUNET_MIN (len - off,
+                        chunk);
+    GNUNET_assert (GNUNET_OK ==
+                   GNUNET_SERVER_mst_receive (mst, NULL, &stream[off], chunk,
+                                              GNUNET_NO, GNUNET_NO));
+    off += chunk;
+  }
+  GNUNET_assert (NUM_MSGS == received);
+  GNUNET_SERVER_mst_destroy (mst);
+  GNUNET_free (stream);
+  return 0;
+}
+
+/* end of test_server_mst.c */
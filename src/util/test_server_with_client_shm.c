@@ -0,0 +1,220 @@
+/*
+     This file is part of GNUnet.
+     Copyright (C) 2015 Christian Grothoff (and other contributing authors)
+
+     GNUnet is free software; you can redistribute it and/or modify
+     it under the terms of the GNU General Public License as published
+     by the Free Software Foundation; either version 3, or (at your
+     option) any later version.
+
+     GNUnet is distributed in the hope that it will be useful, but
+     WITHOUT ANY WARRANTY; without even the implied warranty of
+     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+     General Public License for more details.
+
+     You should have received a copy of the GNU General Public License
+     along with GNUnet; see the file COPYING.  If not, write to the
+     Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+     Boston, MA 02110-1301, USA.
+*/
+/**
+ * @file util/test_server_with_client_shm.c
+ * @brief tests for server.c, client.c and connection.c,
+ *       specifically exchanging data through shared memory
+ */
+#include "platform.h"
+#include "gnunet_util_lib.h"
+
+#define MY_TYPE 128
+
+#define MY_TYPE2 129
+
+/**
+ * How many messages does the client send?  Together, they do not
+ * fit into the shared memory ring.
+ */
+#define NUM_MESSAGES 1000
+
+/**
+ * Size of each message sent by the client.
+ */
+#define MSG_SIZE 1024
+
+/**
+ * Size of the reply of the server.
+ */
+#define REPLY_SIZE 60000
+
+
+static struct GNUNET_SERVER_Handle *server;
+
+static struct GNUNET_CLIENT_Connection *client;
+
+static struct GNUNET_CONFIGURATION_Handle *cfg;
+
+static unsigned int sent;
+
+static unsigned int received;
+
+static int ok;
+
+
+static void
+clean_up (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  GNUNET_SERVER_destroy (server);
+  server = NULL;
+  GNUNET_CONFIGURATION_destroy (cfg);
+  cfg = NULL;
+}
+
+
+static void
+notify_disconnect (void *cls, struct GNUNET_SERVER_Client *client)
+{
+  if (NULL == client)
+    return;
+  GNUNET_assert (3 == ok);
+  ok = 0;
+  GNUNET_SCHEDULER_add_now (&clean_up, NULL);
+}
+
+
+static void
+reply_cb (void *cls, const struct GNUNET_MessageHeader *msg)
+{
+  const char *body;
+  unsigned int i;
+
+  GNUNET_assert (2 == ok);
+  GNUNET_assert (NULL != msg);
+  GNUNET_assert (MY_TYPE2 == ntohs (msg->type));
+  GNUNET_assert (REPLY_SIZE == ntohs (msg->size));
+  body = (const char *) &msg[1];
+  for (i = 0; i < REPLY_SIZE - sizeof (struct GNUNET_MessageHeader); i++)
+    GNUNET_assert ((char) i == body[i]);
+  ok++;
+  GNUNET_CLIENT_disconnect (client);
+  client = NULL;
+}
+
+
+static size_t
+reply_ready (void *cls, size_t size, void *buf)
+{
+  struct GNUNET_MessageHeader *msg = buf;
+  char *body;
+  unsigned int i;
+
+  GNUNET_assert (size >= REPLY_SIZE);
+  msg->type = htons (MY_TYPE2);
+  msg->size = htons (REPLY_SIZE);
+  body = (char *) &msg[1];
+  for (i = 0; i < REPLY_SIZE - sizeof (struct GNUNET_MessageHeader); i++)
+    body[i] = (char) i;
+  return REPLY_SIZE;
+}
+
+
+static void
+recv_cb (void *cls, struct GNUNET_SERVER_Client *argclient,
+         const struct GNUNET_MessageHeader *message)
+{
+  const char *body = (const char *) &message[1];
+
+  GNUNET_assert (1 == ok);
+  GNUNET_assert ((char) received == body[0]);
+  GNUNET_assert ((char) received == body[MSG_SIZE - sizeof (*message) - 1]);
+  received++;
+  if (NUM_MESSAGES == received)
+  {
+    ok++;
+    GNUNET_assert (NULL !=
+                   GNUNET_SERVER_notify_transmit_ready (argclient, REPLY_SIZE,
+                                                        GNUNET_TIME_UNIT_SECONDS,
+                                                        &reply_ready, NULL));
+  }
+  GNUNET_SERVER_receive_done (argclient, GNUNET_OK);
+}
+
+
+static size_t
+notify_ready (void *cls, size_t size, void *buf)
+{
+  struct GNUNET_MessageHeader *msg = buf;
+
+  GNUNET_assert (size >= MSG_SIZE);
+  msg->type = htons (MY_TYPE);
+  msg->size = htons (MSG_SIZE);
+  memset (&msg[1], (char) sent, MSG_SIZE - sizeof (*msg));
+  sent++;
+  if (NUM_MESSAGES > sent)
+    GNUNET_CLIENT_notify_transmit_ready (client, MSG_SIZE,
+                                         GNUNET_TIME_UNIT_SECONDS,
+                                         GNUNET_NO, &notify_ready, NULL);
+  else
+    GNUNET_CLIENT_receive (client, &reply_cb, NULL,
+                           GNUNET_TIME_UNIT_SECONDS);
+  return MSG_SIZE;
+}
+
+
+static struct GNUNET_SERVER_MessageHandler handlers[] = {
+  {&recv_cb, NULL, MY_TYPE, MSG_SIZE},
+  {NULL, NULL, 0, 0}
+};
+
+
+static void
+task (void *cls, const struct GNUNET_SCHEDULER_TaskContext *tc)
+{
+  struct sockaddr_un un;
+  const char *unixpath = "/tmp/testsock-shm";
+  struct sockaddr *sap[2];
+  socklen_t slens[2];
+
+  memset (&un, 0, sizeof (un));
+  un.sun_family = AF_UNIX;
+  strncpy (un.sun_path, unixpath, sizeof (un.sun_path) - 1);
+#if HAVE_SOCKADDR_IN_SIN_LEN
+  un.sun_len = (u_char) sizeof (un);
+#endif
+
+  sap[0] = (struct sockaddr *) &un;
+  slens[0] = sizeof (un);
+  sap[1] = NULL;
+  slens[1] = 0;
+  server =
+      GNUNET_SERVER_create (NULL, NULL, sap, slens,
+                            GNUNET_TIME_UNIT_SECONDS, GNUNET_NO);
+  GNUNET_assert (server != NULL);
+  GNUNET_SERVER_enable_shm_ (server);
+  GNUNET_SERVER_add_handlers (server, handlers);
+  GNUNET_SERVER_disconnect_notify (server, &notify_disconnect, NULL);
+  cfg = GNUNET_CONFIGURATION_create ();
+
+  GNUNET_CONFIGURATION_set_value_string (cfg, "test", "UNIXPATH", unixpath);
+  GNUNET_CONFIGURATION_set_value_string (cfg, "test", "SHM_IPC", "YES");
+  GNUNET_CONFIGURATION_set_value_string (cfg, "resolver", "HOSTNAME",
+                                         "localhost");
+
+  client = GNUNET_CLIENT_connect ("test", cfg);
+  GNUNET_assert (client != NULL);
+  GNUNET_CLIENT_notify_transmit_ready (client, MSG_SIZE,
+                                       GNUNET_TIME_UNIT_SECONDS,
+                                       GNUNET_NO, &notify_ready, NULL);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  GNUNET_log_setup ("test_server_with_client_shm",
+                    "WARNING",
+                    NULL);
+  ok = 1;
+  GNUNET_SCHEDULER_run (&task, NULL);
+  return ok;
+}
+
+/* end of test_server_with_client_shm.c */
@@ -55,6 +55,24 @@ main (int argc, char *argv[])
       ret = 1;
     }
   }
+  /* same with varying bytes, to cover all bit positions */
+  for (i=0;i<sizeof(src);i++)
+  {
+    unsigned int j;
+
+    for (j=0;j<i;j++)
+      src[j] = (char) (i * 31 + j * 7);
+    end = GNUNET_STRINGS_data_to_string (&src, i, buf, sizeof (buf));
+    GNUNET_assert (NULL != end);
+    end[0] = '\0';
+    if ( (GNUNET_OK !=
+          GNUNET_STRINGS_string_to_data (buf, strlen (buf), dst, i)) ||
+         (0 != memcmp (src, dst, i)) )
+    {
+      fprintf (stderr, "%u failed round-trip (%u bytes)\n", i, (unsigned int) strlen (buf));
+      ret = 1;
+    }
+  }
   return ret;
 }
 
@@ -57,6 +57,17 @@
  */
 #define MAX_SIZE 65536
 
+/**
+ * Maximum number of queues we open on the tun interface.
+ */
+#define MAX_QUEUES 4
+
+/**
+ * Size of the buffer in which we collect packets from the interface
+ * before passing them to stdout with a single write.
+ */
+#define BATCH_SIZE (4 * MAX_SIZE)
+
 #ifndef _LINUX_IN6_H
 /**
  * This is in linux/include/net/ipv6.h, but not always exported...
@@ -71,23 +82,22 @@ struct in6_ifreq
 
 
 /**
- * Creates a tun-interface called dev;
+ * Open one queue of the tun-interface called dev.
  *
  * @param dev is asumed to point to a char[IFNAMSIZ]
  *        if *dev == '\\0', uses the name supplied by the kernel;
- * @return the fd to the tun or -1 on error
+ * @param flags flags for the interface (IFF_TUN, possibly IFF_MULTI_QUEUE)
+ * @param quiet do not report ioctl failures
+ * @return the fd to the queue or -1 on error
  */
 static int
-init_tun (char *dev)
+open_tun_queue (char *dev,
+                short flags,
+                int quiet)
 {
   struct ifreq ifr;
   int fd;
-
-  if (NULL == dev)
-  {
-    errno = EINVAL;
-    return -1;
-  }
+  int eno;
 
   if (-1 == (fd = open ("/dev/net/tun", O_RDWR)))
   {
@@ -104,15 +114,28 @@ init_tun (char *dev)
   }
 
   memset (&ifr, 0, sizeof (ifr));
-  ifr.ifr_flags = IFF_TUN;
+  ifr.ifr_flags = flags;
 
   if ('\0' != *dev)
     strncpy (ifr.ifr_name, dev, IFNAMSIZ);
 
   if (-1 == ioctl (fd, TUNSETIFF, (void *) &ifr))
+  {
+    eno = errno;
+    if (! quiet)
+      fprintf (stderr,
+               "Error with ioctl on `%s': %s\n",
+               "/dev/net/tun",
+               strerror (errno));
+    (void) close (fd);
+    errno = eno;
+    return -1;
+  }
+  /* we drain each queue completely per select() round */
+  if (-1 == fcntl (fd, F_SETFL, fcntl (fd, F_GETFL) | O_NONBLOCK))
   {
     fprintf (stderr,
-             "Error with ioctl on `%s': %s\n",
+             "Error making `%s' non-blocking: %s\n",
              "/dev/net/tun",
              strerror (errno));
     (void) close (fd);
@@ -123,6 +146,43 @@ init_tun (char *dev)
 }
 
 
+/**
+ * Creates a tun-interface called dev; if the kernel supports it,
+ * the interface gets several queues (so that the kernel can spread
+ * the flows it sends us over several file descriptors).
+ *
+ * @param dev is asumed to point to a char[IFNAMSIZ]
+ *        if *dev == '\\0', uses the name supplied by the kernel;
+ * @param fds where to store the fds of the queues
+ * @return number of queues opened (at most #MAX_QUEUES), 0 on error
+ */
+static unsigned int
+init_tun (char *dev,
+          int fds[MAX_QUEUES])
+{
+  unsigned int num_fds;
+
+  if (NULL == dev)
+  {
+    errno = EINVAL;
+    return 0;
+  }
+#ifdef IFF_MULTI_QUEUE
+  if (-1 != (fds[0] = open_tun_queue (dev, IFF_TUN | IFF_MULTI_QUEUE, 1)))
+  {
+    for (num_fds = 1; num_fds < MAX_QUEUES; num_fds++)
+      if (-1 == (fds[num_fds] = open_tun_queue (dev, IFF_TUN | IFF_MULTI_QUEUE, 0)))
+        break;
+    return num_fds;
+  }
+  /* kernel too old for IFF_MULTI_QUEUE, fall back to a single queue */
+#endif
+  if (-1 == (fds[0] = open_tun_queue (dev, IFF_TUN, 0)))
+    return 0;
+  return 1;
+}
+
+
 /**
  * @brief Sets the IPv6-Address given in address on the interface dev
  *
@@ -329,48 +389,61 @@ set_address4 (const char *dev, const char *address, const char *mask)
 
 
 /**
- * Start forwarding to and from the tunnel.
+ * Start forwarding to and from the tunnel.  Packets from the
+ * interface are read from all queues until they would block and
+ * passed to stdout in batches; all complete messages from stdin are
+ * written to the interface before we read from stdin again.
  *
- * @param fd_tun tunnel FD
+ * @param fds_tun tunnel FDs (one per queue)
+ * @param num_fds number of entries in @a fds_tun
  */
 static void
-run (int fd_tun)
+run (const int *fds_tun,
+     unsigned int num_fds)
 {
   /*
-   * The buffer filled by reading from fd_tun
+   * The buffer filled by reading from fds_tun
    */
-  unsigned char buftun[MAX_SIZE];
-  ssize_t buftun_size = 0;
-  unsigned char *buftun_read = NULL;
+  unsigned char buftun[BATCH_SIZE];
+  size_t buftun_size = 0;
+  size_t buftun_wpos = 0;
 
   /*
    * The buffer filled by reading from stdin
    */
   unsigned char bufin[MAX_SIZE];
-  ssize_t bufin_size = 0;
   size_t bufin_rpos = 0;
-  unsigned char *bufin_read = NULL;
+  size_t bufin_wpos = 0;
+  /* set if the tun device did not take our last packet */
+  int tun_blocked = 0;
 
   fd_set fds_w;
   fd_set fds_r;
+  int max_fd;
+  unsigned int i;
 
-  /* read refers to reading from fd_tun, writing to stdout */
+  /* read refers to reading from fds_tun, writing to stdout */
   int read_open = 1;
 
-  /* write refers to reading from stdin, writing to fd_tun */
+  /* write refers to reading from stdin, writing to fds_tun */
   int write_open = 1;
 
+  max_fd = 1;
+  for (i = 0; i < num_fds; i++)
+    if (fds_tun[i] > max_fd)
+      max_fd = fds_tun[i];
   while ((1 == read_open) && (1 == write_open))
   {
     FD_ZERO (&fds_w);
     FD_ZERO (&fds_r);
 
     /*
-     * We are supposed to read and the buffer is empty
+     * We are supposed to read and the buffer has room for another packet
      * -> select on read from tun
      */
-    if (read_open && (0 == buftun_size))
-      FD_SET (fd_tun, &fds_r);
+    if (read_open && (BATCH_SIZE - buftun_size >= MAX_SIZE))
+      for (i = 0; i < num_fds; i++)
+        FD_SET (fds_tun[i], &fds_r);
 
     /*
      * We are supposed to read and the buffer is not empty
@@ -380,20 +453,20 @@ run (int fd_tun)
       FD_SET (1, &fds_w);
 
     /*
-     * We are supposed to write and the buffer is empty
+     * We are supposed to write and the tun device takes packets
      * -> select on read from stdin
      */
-    if (write_open && (NULL == bufin_read))
+    if (write_open && (! tun_blocked))
       FD_SET (0, &fds_r);
 
     /*
-     * We are supposed to write and the buffer is not empty
+     * We are supposed to write and the tun device was busy
      * -> select on write to tun
      */
-    if (write_open && (NULL != bufin_read))
-      FD_SET (fd_tun, &fds_w);
+    if (write_open && tun_blocked)
+      FD_SET (fds_tun[0], &fds_w);
 
-    int r = select (fd_tun + 1, &fds_r, &fds_w, NULL, NULL);
+    int r = select (max_fd + 1, &fds_r, &fds_w, NULL, NULL);
 
     if (-1 == r)
     {
@@ -405,42 +478,55 @@ run (int fd_tun)
 
     if (r > 0)
     {
-      if (FD_ISSET (fd_tun, &fds_r))
+      for (i = 0; (1 == read_open) && (i < num_fds); i++)
       {
-        buftun_size =
-            read (fd_tun, buftun + sizeof (struct GNUNET_MessageHeader),
-                  MAX_SIZE - sizeof (struct GNUNET_MessageHeader));
-        if (-1 == buftun_size)
-        {
-          fprintf (stderr,
-                   "read-error: %s\n",
-                   strerror (errno));
-          shutdown (fd_tun, SHUT_RD);
-          shutdown (1, SHUT_WR);
-          read_open = 0;
-          buftun_size = 0;
-        }
-        else if (0 == buftun_size)
-        {
-          fprintf (stderr, "EOF on tun\n");
-          shutdown (fd_tun, SHUT_RD);
-          shutdown (1, SHUT_WR);
-          read_open = 0;
-          buftun_size = 0;
-        }
-        else
+        if (! FD_ISSET (fds_tun[i], &fds_r))
+          continue;
+        /* drain the queue while there is room for a maximum-size packet */
+        while (BATCH_SIZE - buftun_size >= MAX_SIZE)
         {
-          buftun_read = buftun;
           struct GNUNET_MessageHeader *hdr =
-              (struct GNUNET_MessageHeader *) buftun;
-          buftun_size += sizeof (struct GNUNET_MessageHeader);
+              (struct GNUNET_MessageHeader *) &buftun[buftun_size];
+          ssize_t len =
+              read (fds_tun[i], &hdr[1],
+                    UINT16_MAX - sizeof (struct GNUNET_MessageHeader));
+
+          if (-1 == len)
+          {
+            if ( (EAGAIN == errno) ||
+                 (EWOULDBLOCK == errno) ||
+                 (EINTR == errno) )
+              break;
+            fprintf (stderr,
+                     "read-error: %s\n",
+                     strerror (errno));
+            read_open = 0;
+            break;
+          }
+          if (0 == len)
+          {
+            fprintf (stderr, "EOF on tun\n");
+            read_open = 0;
+            break;
+          }
+          len += sizeof (struct GNUNET_MessageHeader);
           hdr->type = htons (GNUNET_MESSAGE_TYPE_VPN_HELPER);
-          hdr->size = htons (buftun_size);
+          hdr->size = htons ((uint16_t) len);
+          buftun_size += len;
         }
       }
+      if (! read_open)
+      {
+        for (i = 0; i < num_fds; i++)
+          shutdown (fds_tun[i], SHUT_RD);
+        shutdown (1, SHUT_WR);
+        buftun_size = 0;
+        buftun_wpos = 0;
+      }
       else if (FD_ISSET (1, &fds_w))
       {
-        ssize_t written = write (1, buftun_read, buftun_size);
+        ssize_t written = write (1, &buftun[buftun_wpos],
+                                 buftun_size - buftun_wpos);
 
         if (-1 == written)
         {
@@ -450,10 +536,12 @@ run (int fd_tun)
 	    fprintf (stderr,
                      "write-error to stdout: %s\n",
                      strerror (errno));
-          shutdown (fd_tun, SHUT_RD);
+          for (i = 0; i < num_fds; i++)
+            shutdown (fds_tun[i], SHUT_RD);
           shutdown (1, SHUT_WR);
           read_open = 0;
           buftun_size = 0;
+          buftun_wpos = 0;
         }
         else if (0 == written)
         {
@@ -462,84 +550,100 @@ run (int fd_tun)
         }
         else
         {
-          buftun_size -= written;
-          buftun_read += written;
+          buftun_wpos += written;
+          if (buftun_wpos == buftun_size)
+          {
+            buftun_size = 0;
+            buftun_wpos = 0;
+          }
+          else if (BATCH_SIZE - buftun_size < MAX_SIZE)
+          {
+            /* make room for reading again */
+            memmove (buftun, &buftun[buftun_wpos], buftun_size - buftun_wpos);
+            buftun_size -= buftun_wpos;
+            buftun_wpos = 0;
+          }
         }
       }
 
       if (FD_ISSET (0, &fds_r))
       {
-        bufin_size = read (0, bufin + bufin_rpos, MAX_SIZE - bufin_rpos);
-        if (-1 == bufin_size)
+        ssize_t len = read (0, &bufin[bufin_rpos], MAX_SIZE - bufin_rpos);
+
+        if (-1 == len)
         {
           fprintf (stderr,
                    "read-error: %s\n",
                    strerror (errno));
-          shutdown (0, SHUT_RD);
-          shutdown (fd_tun, SHUT_WR);
           write_open = 0;
-          bufin_size = 0;
         }
-        else if (0 == bufin_size)
+        else if (0 == len)
         {
 #if DEBUG
           fprintf (stderr, "EOF on stdin\n");
 #endif
-          shutdown (0, SHUT_RD);
-          shutdown (fd_tun, SHUT_WR);
           write_open = 0;
-          bufin_size = 0;
         }
         else
         {
-          struct GNUNET_MessageHeader *hdr;
-
-PROCESS_BUFFER:
-          bufin_rpos += bufin_size;
-          if (bufin_rpos < sizeof (struct GNUNET_MessageHeader))
-            continue;
-          hdr = (struct GNUNET_MessageHeader *) bufin;
-          if (ntohs (hdr->type) != GNUNET_MESSAGE_TYPE_VPN_HELPER)
-          {
-            fprintf (stderr, "protocol violation!\n");
-            exit (1);
-          }
-          if (ntohs (hdr->size) > bufin_rpos)
-            continue;
-          bufin_read = bufin + sizeof (struct GNUNET_MessageHeader);
-          bufin_size = ntohs (hdr->size) - sizeof (struct GNUNET_MessageHeader);
-          bufin_rpos -= bufin_size + sizeof (struct GNUNET_MessageHeader);
+          bufin_rpos += len;
         }
       }
-      else if (FD_ISSET (fd_tun, &fds_w))
+      else if (FD_ISSET (fds_tun[0], &fds_w))
+      {
+        tun_blocked = 0;
+      }
+
+      /* pass all complete messages to the tun device */
+      while ( (1 == write_open) &&
+              (! tun_blocked) &&
+              (bufin_rpos - bufin_wpos >= sizeof (struct GNUNET_MessageHeader)) )
       {
-        ssize_t written = write (fd_tun, bufin_read, bufin_size);
+        const struct GNUNET_MessageHeader *hdr =
+            (const struct GNUNET_MessageHeader *) &bufin[bufin_wpos];
+        uint16_t msize = ntohs (hdr->size);
+
+        if ( (ntohs (hdr->type) != GNUNET_MESSAGE_TYPE_VPN_HELPER) ||
+             (msize < sizeof (struct GNUNET_MessageHeader)) )
+        {
+          fprintf (stderr, "protocol violation!\n");
+          exit (1);
+        }
+        if (msize > bufin_rpos - bufin_wpos)
+          break;
+        ssize_t written = write (fds_tun[0], &hdr[1],
+                                 msize - sizeof (struct GNUNET_MessageHeader));
 
         if (-1 == written)
         {
+          if ( (EAGAIN == errno) ||
+               (EWOULDBLOCK == errno) )
+          {
+            tun_blocked = 1;
+            break;
+          }
           fprintf (stderr, "write-error to tun: %s\n", strerror (errno));
-          shutdown (0, SHUT_RD);
-          shutdown (fd_tun, SHUT_WR);
           write_open = 0;
-          bufin_size = 0;
         }
         else if (0 == written)
         {
           fprintf (stderr, "write returned 0!?\n");
           exit (1);
         }
-        else
-        {
-          bufin_size -= written;
-          bufin_read += written;
-          if (0 == bufin_size)
-          {
-            memmove (bufin, bufin_read, bufin_rpos);
-            bufin_read = NULL;  /* start reading again */
-            bufin_size = 0;
-            goto PROCESS_BUFFER;
-          }
-        }
+        /* the tun device takes whole packets (or none at all) */
+        bufin_wpos += msize;
+      }
+      if (! write_open)
+      {
+        shutdown (0, SHUT_RD);
+        for (i = 0; i < num_fds; i++)
+          shutdown (fds_tun[i], SHUT_WR);
+      }
+      else
+      {
+        memmove (bufin, &bufin[bufin_wpos], bufin_rpos - bufin_wpos);
+        bufin_rpos -= bufin_wpos;
+        bufin_wpos = 0;
       }
     }
   }
@@ -561,7 +665,9 @@ int
 main (int argc, char **argv)
 {
   char dev[IFNAMSIZ];
-  int fd_tun;
+  int fds_tun[MAX_QUEUES];
+  unsigned int num_fds;
+  unsigned int i;
   int global_ret;
 
   if (6 != argc)
@@ -573,7 +679,7 @@ main (int argc, char **argv)
   strncpy (dev, argv[1], IFNAMSIZ);
   dev[IFNAMSIZ - 1] = '\0';
 
-  if (-1 == (fd_tun = init_tun (dev)))
+  if (0 == (num_fds = init_tun (dev, fds_tun)))
   {
     fprintf (stderr, "Fatal: could not initialize tun-interface `%s'  with IPv6 %s/%s and IPv4 %s/%s\n",
 	     dev,
@@ -629,9 +735,10 @@ main (int argc, char **argv)
              strerror (errno));
     /* no exit, we might as well die with SIGPIPE should it ever happen */
   }
-  run (fd_tun);
+  run (fds_tun, num_fds);
   global_ret = 0;
  cleanup:
-  close (fd_tun);
+  for (i = 0; i < num_fds; i++)
+    (void) close (fds_tun[i]);
   return global_ret;
 }
@@ -40,6 +40,7 @@
 #include "gnunet_constants.h"
 #include "gnunet_tun_lib.h"
 #include "gnunet_regex_service.h"
+#include "gnunet_vpn_service.h"
 #include "vpn.h"
 #include "exit.h"
 
@@ -125,6 +126,18 @@ struct DestinationEntry
    */
   int is_service;
 
+  /**
+   * Address family of the pool our local address for this
+   * destination was allocated from (AF_INET or AF_INET6),
+   * AF_UNSPEC if we do not hold a pool address.
+   */
+  int pool_af;
+
+  /**
+   * Index of our local address in the respective address pool.
+   */
+  uint32_t pool_index;
+
   /**
    * Details about the connection (depending on is_service).
    */
@@ -176,6 +189,50 @@ struct DestinationEntry
 };
 
 
+/**
+ * Pool of the addresses from one of our ranges that we can hand out
+ * for destinations.  Addresses are identified by their index; the
+ * free indices are kept in a ring, so allocation and release are O(1)
+ * regardless of utilisation, and a released address is only handed
+ * out again after all other free addresses have been used.
+ */
+struct AddressPool
+{
+
+  /**
+   * Ring of indices of free addresses, @e size slots.
+   */
+  unsigned int *ring;
+
+  /**
+   * Number of addresses in the pool (slots in @e ring).
+   */
+  unsigned int size;
+
+  /**
+   * Position in @e ring of the next free index to hand out.
+   */
+  unsigned int head;
+
+  /**
+   * Number of free indices in @e ring (starting at @e head).
+   */
+  unsigned int free_count;
+
+  /**
+   * Offset of index 0 among the usable host numbers of the range.
+   */
+  uint64_t base;
+
+  /**
+   * Number of usable host numbers in the range (excluding the
+   * network and broadcast addresses).
+   */
+  uint64_t range;
+
+};
+
+
 /**
  * A messages we have in queue for a particular channel.
  */
@@ -393,6 +450,27 @@ static unsigned long long max_destination_mappings;
  */
 static unsigned long long max_channel_mappings;
 
+/**
+ * Pool of IPv4 addresses we hand out for destinations.
+ */
+static struct AddressPool v4_pool;
+
+/**
+ * Pool of IPv6 addresses we hand out for destinations.
+ */
+static struct AddressPool v6_pool;
+
+/**
+ * Smallest number of addresses we put into a pool (if the range
+ * is big enough); a larger pool delays reuse of released addresses.
+ */
+#define MIN_POOL_SIZE 65536
+
+/**
+ * Largest number of addresses we put into a pool.
+ */
+#define MAX_POOL_SIZE (4 * 1024 * 1024)
+
 
 /**
  * Compute the key under which we would store an entry in the
@@ -1295,8 +1373,13 @@ route_packet (struct DestinationEntry *destination,
       tdm = (struct  GNUNET_EXIT_TcpDataMessage *) &tnq[1];
       tdm->header.size = htons ((uint16_t) mlen);
       tdm->header.type = htons (GNUNET_MESSAGE_TYPE_VPN_TCP_DATA_TO_EXIT);
-      tdm->reserved = htonl (0);
+      tdm->flags = htonl (GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM);
       tdm->tcp_header = *tcp;
+      tdm->tcp_header.crc = GNUNET_TUN_tcp_checksum_to_partial (af,
+								source_ip,
+								destination_ip,
+								tcp,
+								(uint16_t) payload_length);
       memcpy (&tdm[1],
 	      &tcp[1],
 	      payload_length - sizeof (struct GNUNET_TUN_TcpHeader));
@@ -2298,10 +2381,18 @@ receive_tcp_back (void *cls,
 	*tcp = data->tcp_header;
 	tcp->source_port = htons (ts->destination_port);
 	tcp->destination_port = htons (ts->source_port);
-	GNUNET_TUN_calculate_tcp4_checksum (ipv4,
-					    tcp,
-					    &data[1],
-					    mlen);
+	if (0 != (ntohl (data->flags) & GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM))
+	  GNUNET_TUN_calculate_tcp_checksum_from_partial (AF_INET,
+							  &ipv4->source_address,
+							  &ipv4->destination_address,
+							  tcp,
+							  sizeof (struct GNUNET_TUN_TcpHeader) + mlen,
+							  data->tcp_header.crc);
+	else
+	  GNUNET_TUN_calculate_tcp4_checksum (ipv4,
+					      tcp,
+					      &data[1],
+					      mlen);
 	memcpy (&tcp[1],
 		&data[1],
 		mlen);
@@ -2337,10 +2428,18 @@ receive_tcp_back (void *cls,
 	*tcp = data->tcp_header;
 	tcp->source_port = htons (ts->destination_port);
 	tcp->destination_port = htons (ts->source_port);
-	GNUNET_TUN_calculate_tcp6_checksum (ipv6,
-					    tcp,
-					    &data[1],
-					    mlen);
+	if (0 != (ntohl (data->flags) & GNUNET_EXIT_TCP_FLAG_PARTIAL_CHECKSUM))
+	  GNUNET_TUN_calculate_tcp_checksum_from_partial (AF_INET6,
+							  &ipv6->source_address,
+							  &ipv6->destination_address,
+							  tcp,
+							  sizeof (struct GNUNET_TUN_TcpHeader) + mlen,
+							  data->tcp_header.crc);
+	else
+	  GNUNET_TUN_calculate_tcp6_checksum (ipv6,
+					      tcp,
+					      &data[1],
+					      mlen);
 	memcpy (&tcp[1],
 		&data[1],
 		mlen);
@@ -2360,53 +2459,212 @@ receive_tcp_back (void *cls,
 }
 
 
+/**
+ * Setup an address pool for a range.
+ *
+ * @param pool pool to initialize
+ * @param range number of usable host numbers in the range
+ * @param own host number of our own address in the range
+ */
+static void
+init_address_pool (struct AddressPool *pool,
+                   uint64_t range,
+                   uint64_t own)
+{
+  uint64_t size;
+  uint64_t own_index;
+  unsigned int i;
+
+  memset (pool, 0, sizeof (struct AddressPool));
+  if (0 == range)
+    return;
+  size = GNUNET_MAX (4 * max_destination_mappings,
+                     MIN_POOL_SIZE);
+  size = GNUNET_MIN (size, MAX_POOL_SIZE);
+  size = GNUNET_MIN (size, range);
+  pool->range = range;
+  pool->base = GNUNET_CRYPTO_random_u64 (GNUNET_CRYPTO_QUALITY_WEAK,
+                                         range);
+  pool->size = (unsigned int) size;
+  pool->ring = GNUNET_CRYPTO_random_permute (GNUNET_CRYPTO_QUALITY_WEAK,
+                                             pool->size);
+  pool->free_count = pool->size;
+  if ( (0 == own) ||
+       (own > range) )
+    return;
+  /* never hand out our own address; move it into the (unused)
+     last slot of the ring */
+  own_index = (own - 1 >= pool->base)
+    ? own - 1 - pool->base
+    : own - 1 + (range - pool->base);
+  if (own_index >= size)
+    return;
+  for (i=0;i<pool->size;i++)
+  {
+    if (pool->ring[i] != (unsigned int) own_index)
+      continue;
+    pool->ring[i] = pool->ring[pool->size - 1];
+    pool->ring[pool->size - 1] = (unsigned int) own_index;
+    pool->free_count--;
+    break;
+  }
+}
+
+
+/**
+ * Release all resources of an address pool.
+ *
+ * @param pool pool to clean up
+ */
+static void
+destroy_address_pool (struct AddressPool *pool)
+{
+  GNUNET_free_non_null (pool->ring);
+  memset (pool, 0, sizeof (struct AddressPool));
+}
+
+
+/**
+ * Take the next free address from a pool.
+ *
+ * @param pool pool to allocate from
+ * @param index set to the index of the allocated address
+ * @param host set to the host number of the allocated address
+ * @return #GNUNET_OK on success,
+ *         #GNUNET_SYSERR if the pool is exhausted
+ */
+static int
+address_pool_get (struct AddressPool *pool,
+                  uint32_t *index,
+                  uint64_t *host)
+{
+  uint64_t off;
+
+  if (0 == pool->free_count)
+    return GNUNET_SYSERR;
+  *index = pool->ring[pool->head];
+  pool->head = (pool->head + 1) % pool->size;
+  pool->free_count--;
+  /* base < range and index < range, so one subtraction suffices
+     (also if the addition wraps around) */
+  off = pool->base + *index;
+  if ( (off >= pool->range) ||
+       (off < pool->base) )
+    off -= pool->range;
+  *host = off + 1;
+  return GNUNET_OK;
+}
+
+
+/**
+ * Return an address to its pool.
+ *
+ * @param pool pool the address was allocated from
+ * @param index index of the address
+ */
+static void
+address_pool_put (struct AddressPool *pool,
+                  uint32_t index)
+{
+  GNUNET_assert (pool->free_count < pool->size);
+  pool->ring[(pool->head + pool->free_count) % pool->size] = index;
+  pool->free_count++;
+}
+
+
+/**
+ * Setup the IPv4 address pool from our configured range.
+ */
+static void
+init_v4_pool ()
+{
+  const char *ipv4addr = vpn_argv[4];
+  const char *ipv4mask = vpn_argv[5];
+  struct in_addr addr;
+  struct in_addr mask;
+  uint32_t host_mask;
+
+  if ( (1 != inet_pton (AF_INET, ipv4addr, &addr)) ||
+       (1 != inet_pton (AF_INET, ipv4mask, &mask)) )
+  {
+    /* IPv4 disabled */
+    init_address_pool (&v4_pool, 0, 0);
+    return;
+  }
+  /* Given 192.168.0.1/255.255.0.0, the host numbers 1 to
+     0xFFFE are usable */
+  host_mask = ~ ntohl (mask.s_addr);
+  init_address_pool (&v4_pool,
+                     (host_mask < 2) ? 0 : (uint64_t) host_mask - 1,
+                     ntohl (addr.s_addr) & host_mask);
+}
+
+
+/**
+ * Setup the IPv6 address pool from our configured range.  For
+ * prefixes shorter than /64, host numbers only vary in the lower
+ * 64 bits.
+ */
+static void
+init_v6_pool ()
+{
+  const char *ipv6addr = vpn_argv[2];
+  struct in6_addr addr;
+  uint64_t host_mask;
+  uint64_t own;
+  unsigned int i;
+
+  if (1 != inet_pton (AF_INET6, ipv6addr, &addr))
+  {
+    /* IPv6 disabled */
+    init_address_pool (&v6_pool, 0, 0);
+    return;
+  }
+  GNUNET_assert (ipv6prefix < 128);
+  if (ipv6prefix <= 64)
+    host_mask = UINT64_MAX;
+  else
+    host_mask = (((uint64_t) 1) << (128 - ipv6prefix)) - 1;
+  own = 0;
+  for (i=8;i<16;i++)
+    own = (own << 8) | addr.s6_addr[i];
+  init_address_pool (&v6_pool,
+                     (host_mask < 2) ? 0 : host_mask - 1,
+                     own & host_mask);
+}
+
+
 /**
  * Allocate an IPv4 address from the range of the channel
  * for a new redirection.
  *
  * @param v4 where to store the address
+ * @param index set to the index of the address in #v4_pool
  * @return #GNUNET_OK on success,
  *         #GNUNET_SYSERR on error
  */
 static int
-allocate_v4_address (struct in_addr *v4)
+allocate_v4_address (struct in_addr *v4,
+                     uint32_t *index)
 {
   const char *ipv4addr = vpn_argv[4];
   const char *ipv4mask = vpn_argv[5];
   struct in_addr addr;
   struct in_addr mask;
-  struct in_addr rnd;
-  struct GNUNET_HashCode key;
-  unsigned int tries;
+  uint64_t host;
 
+  if (GNUNET_OK !=
+      address_pool_get (&v4_pool,
+                        index,
+                        &host))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to find unallocated IPv4 address in VPN's range\n"));
+    return GNUNET_SYSERR;
+  }
   GNUNET_assert (1 == inet_pton (AF_INET, ipv4addr, &addr));
   GNUNET_assert (1 == inet_pton (AF_INET, ipv4mask, &mask));
-  /* Given 192.168.0.1/255.255.0.0, we want a mask
-     of '192.168.255.255', thus:  */
-  mask.s_addr = addr.s_addr | ~mask.s_addr;
-  tries = 0;
-  do
-    {
-      tries++;
-      if (tries > 16)
-      {
-	GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-		    _("Failed to find unallocated IPv4 address in VPN's range\n"));
-	return GNUNET_SYSERR;
-      }
-      /* Pick random IPv4 address within the subnet, except 'addr' or 'mask' itself */
-      rnd.s_addr = GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-					     UINT32_MAX);
-      v4->s_addr = (addr.s_addr | rnd.s_addr) & mask.s_addr;
-      get_destination_key_from_ip (AF_INET,
-				   v4,
-				   &key);
-    }
-  while ( (GNUNET_YES ==
-	   GNUNET_CONTAINER_multihashmap_contains (destination_map,
-						   &key)) ||
-	  (v4->s_addr == addr.s_addr) ||
-	  (v4->s_addr == mask.s_addr) );
+  v4->s_addr = (addr.s_addr & mask.s_addr) | htonl ((uint32_t) host);
   return GNUNET_OK;
 }
 
@@ -2416,60 +2674,36 @@ allocate_v4_address (struct in_addr *v4)
  * for a new redirection.
  *
  * @param v6 where to store the address
+ * @param index set to the index of the address in #v6_pool
  * @return #GNUNET_OK on success,
  *         #GNUNET_SYSERR on error
  */
 static int
-allocate_v6_address (struct in6_addr *v6)
+allocate_v6_address (struct in6_addr *v6,
+                     uint32_t *index)
 {
   const char *ipv6addr = vpn_argv[2];
-  struct in6_addr addr;
-  struct in6_addr mask;
-  struct in6_addr rnd;
+  uint64_t host;
   int i;
-  struct GNUNET_HashCode key;
-  unsigned int tries;
-
-  GNUNET_assert (1 == inet_pton (AF_INET6, ipv6addr, &addr));
-  GNUNET_assert (ipv6prefix < 128);
-  /* Given ABCD::/96, we want a mask of 'ABCD::FFFF:FFFF,
-     thus: */
-  mask = addr;
-  for (i=127;i>=ipv6prefix;i--)
-    mask.s6_addr[i / 8] |= (1 << (i % 8));
-
-  /* Pick random IPv6 address within the subnet, except 'addr' or 'mask' itself */
-  tries = 0;
-  do
-    {
-      tries++;
-      if (tries > 16)
-	{
-	  GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
-		      _("Failed to find unallocated IPv6 address in VPN's range\n"));
-	  return GNUNET_SYSERR;
 
-	}
-      for (i=0;i<16;i++)
-	{
-	  rnd.s6_addr[i] = (unsigned char) GNUNET_CRYPTO_random_u32 (GNUNET_CRYPTO_QUALITY_WEAK,
-								     256);
-	  v6->s6_addr[i]
-	    = (addr.s6_addr[i] | rnd.s6_addr[i]) & mask.s6_addr[i];
-	}
-      get_destination_key_from_ip (AF_INET6,
-				   v6,
-				   &key);
-    }
-  while ( (GNUNET_YES ==
-	   GNUNET_CONTAINER_multihashmap_contains (destination_map,
-						   &key)) ||
-	  (0 == memcmp (v6,
-			&addr,
-			sizeof (struct in6_addr))) ||
-	  (0 == memcmp (v6,
-			&mask,
-			sizeof (struct in6_addr))) );
+  if (GNUNET_OK !=
+      address_pool_get (&v6_pool,
+                        index,
+                        &host))
+  {
+    GNUNET_log (GNUNET_ERROR_TYPE_WARNING,
+                _("Failed to find unallocated IPv6 address in VPN's range\n"));
+    return GNUNET_SYSERR;
+  }
+  GNUNET_assert (1 == inet_pton (AF_INET6, ipv6addr, v6));
+  /* clear the host bits, then fill in the host number */
+  for (i=127;i>=(int) ipv6prefix;i--)
+    v6->s6_addr[i / 8] &= ~ (1 << (7 - (i % 8)));
+  for (i=15;i>=8;i--)
+  {
+    v6->s6_addr[i] |= (unsigned char) (host & 0xFF);
+    host >>= 8;
+  }
   return GNUNET_OK;
 }
 
@@ -2506,6 +2740,17 @@ free_destination_entry (struct DestinationEntry *de)
 							 &de->key,
 							 de));
   }
+  switch (de->pool_af)
+  {
+  case AF_INET:
+    address_pool_put (&v4_pool, de->pool_index);
+    break;
+  case AF_INET6:
+    address_pool_put (&v6_pool, de->pool_index);
+    break;
+  default:
+    break;
+  }
   GNUNET_free (de);
 }
 
@@ -2539,6 +2784,7 @@ expire_destination (struct DestinationEntry *except)
  *         storage location was used; set to NULL if allocation failed
  * @param v4 storage space for an IPv4 address
  * @param v6 storage space for an IPv6 address
+ * @param pool_index set to the index of the address in its pool
  * @return #GNUNET_OK normally, #GNUNET_SYSERR if `* result_af` was
  *         an unsupported address family (not AF_INET, AF_INET6 or AF_UNSPEC)
  */
@@ -2546,34 +2792,35 @@ static int
 allocate_response_ip (int *result_af,
 		      void **addr,
 		      struct in_addr *v4,
-		      struct in6_addr *v6)
+		      struct in6_addr *v6,
+		      uint32_t *pool_index)
 {
   *addr = NULL;
   switch (*result_af)
   {
   case AF_INET:
     if (GNUNET_OK !=
-	allocate_v4_address (v4))
+	allocate_v4_address (v4, pool_index))
       *result_af = AF_UNSPEC;
     else
       *addr = v4;
     break;
   case AF_INET6:
     if (GNUNET_OK !=
-	allocate_v6_address (v6))
+	allocate_v6_address (v6, pool_index))
       *result_af = AF_UNSPEC;
     else
       *addr = v6;
     break;
   case AF_UNSPEC:
     if (GNUNET_OK ==
-	allocate_v4_address (v4))
+	allocate_v4_address (v4, pool_index))
     {
       *addr = v4;
       *result_af = AF_INET;
     }
     else if (GNUNET_OK ==
-	allocate_v6_address (v6))
+	allocate_v6_address (v6, pool_index))
     {
       *addr = v6;
       *result_af = AF_INET6;
@@ -2587,6 +2834,86 @@ allocate_response_ip (int *result_af,
 }
 
 
+/**
+ * Allocate an IP address and setup a redirection via some exit node
+ * to the given destination IP.
+ *
+ * @param addr_af address family of @a dest, AF_INET or AF_INET6
+ * @param dest destination IP address on the Internet
+ * @param expiration_time at what time should the redirection expire?
+ * @param result_af desired address family for our IP; set to the
+ *        actual address family, AF_UNSPEC if the allocation failed
+ * @param addr set to either @a v4 or @a v6 depending on which
+ *         storage location was used; set to NULL if allocation failed
+ * @param v4 storage space for an IPv4 address
+ * @param v6 storage space for an IPv6 address
+ * @return #GNUNET_OK normally, #GNUNET_SYSERR if `* result_af` was
+ *         an unsupported address family
+ */
+static int
+setup_ip_redirection (int addr_af,
+		      const void *dest,
+		      struct GNUNET_TIME_Absolute expiration_time,
+		      int *result_af,
+		      void **addr,
+		      struct in_addr *v4,
+		      struct in6_addr *v6)
+{
+  struct DestinationEntry *de;
+  struct GNUNET_HashCode key;
+  uint32_t pool_index;
+
+  if (GNUNET_OK != allocate_response_ip (result_af,
+					 addr,
+					 v4, v6,
+					 &pool_index))
+    return GNUNET_SYSERR;
+  if (AF_UNSPEC == *result_af)
+    return GNUNET_OK; /* failure, we're done */
+
+  {
+    char sbuf[INET6_ADDRSTRLEN];
+    char dbuf[INET6_ADDRSTRLEN];
+
+    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
+		"Allocated address %s for redirection via exit to %s\n",
+		inet_ntop (*result_af, *addr, sbuf, sizeof (sbuf)),
+		inet_ntop (addr_af,
+			   dest, dbuf, sizeof (dbuf)));
+  }
+
+  /* setup destination record */
+  de = GNUNET_new (struct DestinationEntry);
+  de->is_service = GNUNET_NO;
+  de->pool_af = *result_af;
+  de->pool_index = pool_index;
+  de->details.exit_destination.af = addr_af;
+  memcpy (&de->details.exit_destination.ip,
+	  dest,
+	  (AF_INET == addr_af)
+	  ? sizeof (struct in_addr)
+	  : sizeof (struct in6_addr));
+  get_destination_key_from_ip (*result_af,
+			       *addr,
+			       &key);
+  de->key = key;
+  GNUNET_assert (GNUNET_OK ==
+		 GNUNET_CONTAINER_multihashmap_put (destination_map,
+						    &key,
+						    de,
+						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
+  de->heap_node = GNUNET_CONTAINER_heap_insert (destination_heap,
+						de,
+						expiration_time.abs_value_us);
+  GNUNET_STATISTICS_update (stats,
+			    gettext_noop ("# Active destinations"),
+			    1, GNUNET_NO);
+  while (GNUNET_CONTAINER_multihashmap_size (destination_map) > max_destination_mappings)
+    expire_destination (de);
+  return GNUNET_OK;
+}
+
+
 /**
  * A client asks us to setup a redirection via some exit node to a
  * particular IP.  Setup the redirection and give the client the
@@ -2609,8 +2936,6 @@ service_redirect_to_ip (void *cls,
   struct in_addr v4;
   struct in6_addr v6;
   void *addr;
-  struct DestinationEntry *de;
-  struct GNUNET_HashCode key;
 
   /* validate and parse request */
   mlen = ntohs (message->size);
@@ -2647,9 +2972,12 @@ service_redirect_to_ip (void *cls,
     return;
   }
 
-  /* allocate response IP */
+  /* allocate response IP and setup the redirection */
   result_af = (int) htonl (msg->result_af);
-  if (GNUNET_OK != allocate_response_ip (&result_af,
+  if (GNUNET_OK != setup_ip_redirection (addr_af,
+					 &msg[1],
+					 GNUNET_TIME_absolute_ntoh (msg->expiration_time),
+					 &result_af,
 					 &addr,
 					 &v4, &v6))
   {
@@ -2661,48 +2989,105 @@ service_redirect_to_ip (void *cls,
 		     msg->request_id,
 		     result_af,
 		     addr);
-  if (result_af == AF_UNSPEC)
+  GNUNET_SERVER_receive_done (client, GNUNET_OK);
+}
+
+
+/**
+ * A client asks us to setup redirections via some exit node to a
+ * set of IPs (typically all addresses from one DNS response).  Setup
+ * the redirections and give the client all allocated IPs in a single
+ * reply.
+ *
+ * @param cls unused
+ * @param client requesting client
+ * @param message redirection request (a `struct RedirectToIpBatchRequestMessage`)
+ */
+static void
+service_redirect_to_ip_batch (void *cls,
+			      struct GNUNET_SERVER_Client *client,
+			      const struct GNUNET_MessageHeader *message)
+{
+  const struct RedirectToIpBatchRequestMessage *msg;
+  const struct RedirectToIpBatchEntry *req;
+  struct RedirectToIpBatchResponseMessage *res;
+  struct RedirectToIpBatchEntry *rep;
+  struct GNUNET_TIME_Absolute expiration_time;
+  uint16_t mlen;
+  size_t rlen;
+  unsigned int count;
+  unsigned int i;
+  int addr_af;
+  int result_af;
+  struct in_addr v4;
+  struct in6_addr v6;
+  void *addr;
+
+  mlen = ntohs (message->size);
+  msg = (const struct RedirectToIpBatchRequestMessage *) message;
+  count = ntohl (msg->count);
+  if ( (mlen < sizeof (struct RedirectToIpBatchRequestMessage)) ||
+       (count > GNUNET_VPN_MAX_BATCH_SIZE) ||
+       (mlen != sizeof (struct RedirectToIpBatchRequestMessage) +
+	count * sizeof (struct RedirectToIpBatchEntry)) )
   {
-    /* failure, we're done */
-    GNUNET_SERVER_receive_done (client, GNUNET_OK);
+    GNUNET_break (0);
+    GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     return;
   }
-
+  req = (const struct RedirectToIpBatchEntry *) &msg[1];
+  for (i=0;i<count;i++)
   {
-    char sbuf[INET6_ADDRSTRLEN];
-    char dbuf[INET6_ADDRSTRLEN];
-
-    GNUNET_log (GNUNET_ERROR_TYPE_DEBUG,
-		"Allocated address %s for redirection via exit to %s\n",
-		inet_ntop (result_af, addr, sbuf, sizeof (sbuf)),
-		inet_ntop (addr_af,
-			   &msg[1], dbuf, sizeof (dbuf)));
+    addr_af = (int) ntohl (req[i].addr_af);
+    if ( (AF_INET != addr_af) &&
+	 (AF_INET6 != addr_af) )
+    {
+      GNUNET_break (0);
+      GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
+      return;
+    }
+  }
+  expiration_time = GNUNET_TIME_absolute_ntoh (msg->expiration_time);
+  rlen = sizeof (struct RedirectToIpBatchResponseMessage) +
+    count * sizeof (struct RedirectToIpBatchEntry);
+  res = GNUNET_malloc (rlen);
+  res->header.size = htons ((uint16_t) rlen);
+  res->header.type = htons (GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP_BATCH);
+  res->count = msg->count;
+  res->request_id = msg->request_id;
+  rep = (struct RedirectToIpBatchEntry *) &res[1];
+  for (i=0;i<count;i++)
+  {
+    addr_af = (int) ntohl (req[i].addr_af);
+    result_af = (int) ntohl (req[i].result_af);
+    if (GNUNET_OK != setup_ip_redirection (addr_af,
+					   &req[i].addr,
+					   expiration_time,
+					   &result_af,
+					   &addr,
+					   &v4, &v6))
+    {
+      GNUNET_break_op (0);
+      result_af = AF_UNSPEC;
+    }
+    rep[i].result_af = htonl (result_af);
+    rep[i].addr_af = req[i].addr_af;
+    if (AF_UNSPEC != result_af)
+      memcpy (&rep[i].addr,
+	      addr,
+	      (AF_INET == result_af)
+	      ? sizeof (struct in_addr)
+	      : sizeof (struct in6_addr));
   }
-
-  /* setup destination record */
-  de = GNUNET_new (struct DestinationEntry);
-  de->is_service = GNUNET_NO;
-  de->details.exit_destination.af = addr_af;
-  memcpy (&de->details.exit_destination.ip,
-	  &msg[1],
-	  alen);
-  get_destination_key_from_ip (result_af,
-			       addr,
-			       &key);
-  de->key = key;
-  GNUNET_assert (GNUNET_OK ==
-		 GNUNET_CONTAINER_multihashmap_put (destination_map,
-						    &key,
-						    de,
-						    GNUNET_CONTAINER_MULTIHASHMAPOPTION_MULTIPLE));
-  de->heap_node = GNUNET_CONTAINER_heap_insert (destination_heap,
-						de,
-						GNUNET_TIME_absolute_ntoh (msg->expiration_time).abs_value_us);
   GNUNET_STATISTICS_update (stats,
-			    gettext_noop ("# Active destinations"),
+			    gettext_noop ("# Batched redirection requests"),
 			    1, GNUNET_NO);
-  while (GNUNET_CONTAINER_multihashmap_size (destination_map) > max_destination_mappings)
-    expire_destination (de);
+  GNUNET_SERVER_notification_context_add (nc, client);
+  GNUNET_SERVER_notification_context_unicast (nc,
+					      client,
+					      &res->header,
+					      GNUNET_NO);
+  GNUNET_free (res);
   GNUNET_SERVER_receive_done (client, GNUNET_OK);
 }
 
@@ -2729,6 +3114,7 @@ service_redirect_to_service (void *cls,
   struct DestinationEntry *de;
   struct GNUNET_HashCode key;
   struct DestinationChannel *dt;
+  uint32_t pool_index;
 
   /*  parse request */
   msg = (const struct RedirectToServiceRequestMessage *) message;
@@ -2737,7 +3123,8 @@ service_redirect_to_service (void *cls,
   result_af = (int) htonl (msg->result_af);
   if (GNUNET_OK != allocate_response_ip (&result_af,
 					 &addr,
-					 &v4, &v6))
+					 &v4, &v6,
+					 &pool_index))
   {
     GNUNET_SERVER_receive_done (client, GNUNET_SYSERR);
     return;
@@ -2768,6 +3155,8 @@ service_redirect_to_service (void *cls,
   /* setup destination record */
   de = GNUNET_new (struct DestinationEntry);
   de->is_service = GNUNET_YES;
+  de->pool_af = result_af;
+  de->pool_index = pool_index;
   de->details.service_destination.service_descriptor = msg->service_descriptor;
   de->details.service_destination.target = msg->target;
   get_destination_key_from_ip (result_af,
@@ -2889,6 +3278,8 @@ cleanup (void *cls,
     GNUNET_CONTAINER_heap_destroy (destination_heap);
     destination_heap = NULL;
   }
+  destroy_address_pool (&v4_pool);
+  destroy_address_pool (&v6_pool);
   if (NULL != channel_map)
   {
     GNUNET_CONTAINER_multihashmap_iterate (channel_map,
@@ -2943,6 +3334,7 @@ run (void *cls,
   static const struct GNUNET_SERVER_MessageHandler service_handlers[] = {
     /* callback, cls, type, size */
     { &service_redirect_to_ip, NULL, GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_IP, 0},
+    { &service_redirect_to_ip_batch, NULL, GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_IP_BATCH, 0},
     { &service_redirect_to_service, NULL,
      GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_SERVICE,
      sizeof (struct RedirectToServiceRequestMessage) },
@@ -3089,6 +3481,8 @@ run (void *cls,
     vpn_argv[5] = GNUNET_strdup ("-");
   }
   vpn_argv[6] = NULL;
+  init_v4_pool ();
+  init_v6_pool ();
 
   cadet_handle =
     GNUNET_CADET_connect (cfg_, NULL,
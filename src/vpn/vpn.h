@@ -151,6 +151,95 @@ struct RedirectToIpResponseMessage
 
 };
 
+/**
+ * One redirection in a batch request or response.
+ */
+struct RedirectToIpBatchEntry
+{
+
+  /**
+   * Address family desired for the result (AF_INET or AF_INET6 or
+   * AF_UNSPEC, in nbo); in the response, the address family of the
+   * allocated address, "AF_UNSPEC" on errors.
+   */
+  int32_t result_af GNUNET_PACKED;
+
+  /**
+   * Address family used for the destination address (AF_INET or AF_INET6, in nbo)
+   */
+  int32_t addr_af GNUNET_PACKED;
+
+  /**
+   * Destination address in the request, allocated address in the
+   * response; an IPv4 address occupies the first 4 bytes.
+   */
+  struct in6_addr addr;
+
+};
+
+
+/**
+ * Message send by the VPN client to the VPN service requesting
+ * the setup of several redirections via an exit node to global
+ * Internet addresses at once.
+ */
+struct RedirectToIpBatchRequestMessage
+{
+  /**
+   * Type is #GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_IP_BATCH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of `struct RedirectToIpBatchEntry` that follow, in nbo;
+   * at most #GNUNET_VPN_MAX_BATCH_SIZE.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /**
+   * How long should the redirections be maintained at most?
+   */
+  struct GNUNET_TIME_AbsoluteNBO expiration_time;
+
+  /**
+   * Unique ID to match a future response to this request.
+   * Picked by the client.
+   */
+  uint64_t request_id GNUNET_PACKED;
+
+  /* followed by 'count' 'struct RedirectToIpBatchEntry' */
+
+};
+
+
+/**
+ * Response from the VPN service to a VPN client informing about
+ * the IPs that were assigned for a batch of redirections.
+ */
+struct RedirectToIpBatchResponseMessage
+{
+
+  /**
+   * Type is #GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP_BATCH
+   */
+  struct GNUNET_MessageHeader header;
+
+  /**
+   * Number of `struct RedirectToIpBatchEntry` that follow, in nbo;
+   * matches the request.
+   */
+  uint32_t count GNUNET_PACKED;
+
+  /**
+   * Unique ID to match the response to a request.
+   */
+  uint64_t request_id GNUNET_PACKED;
+
+  /* followed by 'count' 'struct RedirectToIpBatchEntry', in the
+     order of the request */
+
+};
+
 GNUNET_NETWORK_STRUCT_END
 
 
@@ -108,10 +108,26 @@ struct GNUNET_VPN_RedirectionRequest
   GNUNET_VPN_AllocationCallback cb;
 
   /**
-   * Closure for 'cb'.
+   * Function to call with the designated IPs (batch requests only).
+   */
+  GNUNET_VPN_BatchAllocationCallback batch_cb;
+
+  /**
+   * Closure for 'cb' or 'batch_cb'.
    */
   void *cb_cls;
 
+  /**
+   * Destinations of a batch request, NULL for other requests.
+   * Allocated after this struct.
+   */
+  const struct GNUNET_VPN_IpDestination *batch;
+
+  /**
+   * Number of entries in 'batch'.
+   */
+  unsigned int batch_size;
+
   /**
    * For service redirection, identity of the peer offering the service.
    */
@@ -159,6 +175,76 @@ static void
 reconnect (struct GNUNET_VPN_Handle *vh);
 
 
+/**
+ * Handle a response to a batch request from the VPN service.
+ *
+ * @param vh VPN handle
+ * @param msg the `struct RedirectToIpBatchResponseMessage`
+ * @return #GNUNET_OK on success, #GNUNET_SYSERR if @a msg was malformed
+ */
+static int
+handle_batch_response (struct GNUNET_VPN_Handle *vh,
+		       const struct GNUNET_MessageHeader *msg)
+{
+  const struct RedirectToIpBatchResponseMessage *rm;
+  const struct RedirectToIpBatchEntry *re;
+  struct GNUNET_VPN_RedirectionRequest *rr;
+  struct GNUNET_VPN_IpAllocation *allocations;
+  unsigned int count;
+  unsigned int i;
+  int af;
+
+  rm = (const struct RedirectToIpBatchResponseMessage *) msg;
+  if (sizeof (struct RedirectToIpBatchResponseMessage) > ntohs (msg->size))
+    return GNUNET_SYSERR;
+  count = ntohl (rm->count);
+  if ( (count > GNUNET_VPN_MAX_BATCH_SIZE) ||
+       (ntohs (msg->size) != sizeof (struct RedirectToIpBatchResponseMessage) +
+	count * sizeof (struct RedirectToIpBatchEntry)) ||
+       (0 == rm->request_id) )
+    return GNUNET_SYSERR;
+  for (rr = vh->rr_head; NULL != rr; rr = rr->next)
+    if (rr->request_id == rm->request_id)
+      break;
+  if (NULL == rr)
+    return GNUNET_OK; /* cancelled */
+  if ( (NULL == rr->batch) ||
+       (count != rr->batch_size) )
+    return GNUNET_SYSERR;
+  re = (const struct RedirectToIpBatchEntry *) &rm[1];
+  allocations = GNUNET_new_array (count + 1,
+				  struct GNUNET_VPN_IpAllocation);
+  for (i=0;i<count;i++)
+  {
+    af = (int) ntohl (re[i].result_af);
+    switch (af)
+    {
+    case AF_INET:
+      memcpy (&allocations[i].address.v4,
+	      &re[i].addr,
+	      sizeof (struct in_addr));
+      break;
+    case AF_INET6:
+      allocations[i].address.v6 = re[i].addr;
+      break;
+    default:
+      af = AF_UNSPEC;
+      break;
+    }
+    allocations[i].af = af;
+  }
+  GNUNET_CONTAINER_DLL_remove (vh->rr_head,
+			       vh->rr_tail,
+			       rr);
+  rr->batch_cb (rr->cb_cls,
+		count,
+		allocations);
+  GNUNET_free (allocations);
+  GNUNET_free (rr);
+  return GNUNET_OK;
+}
+
+
 /**
  * Function called when we receive a message from the VPN service.
  *
@@ -181,6 +267,19 @@ receive_response (void *cls,
     reconnect (vh);
     return;
   }
+  if (ntohs (msg->type) == GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP_BATCH)
+  {
+    if (GNUNET_OK != handle_batch_response (vh, msg))
+    {
+      GNUNET_break (0);
+      reconnect (vh);
+      return;
+    }
+    GNUNET_CLIENT_receive (vh->client,
+			   &receive_response, vh,
+			   GNUNET_TIME_UNIT_FOREVER_REL);
+    return;
+  }
   if ( (ntohs (msg->type) != GNUNET_MESSAGE_TYPE_VPN_CLIENT_USE_IP) ||
        (sizeof (struct RedirectToIpResponseMessage) > (msize = ntohs (msg->size))) )
   {
@@ -233,6 +332,45 @@ receive_response (void *cls,
 }
 
 
+/**
+ * Find the first request that was not yet sent to the service.
+ *
+ * @param vh VPN handle
+ * @return NULL if all requests were sent
+ */
+static struct GNUNET_VPN_RedirectionRequest *
+get_pending_request (struct GNUNET_VPN_Handle *vh)
+{
+  struct GNUNET_VPN_RedirectionRequest *rr;
+
+  rr = vh->rr_head;
+  while ( (NULL != rr) &&
+	  (0 != rr->request_id) )
+    rr = rr->next;
+  return rr;
+}
+
+
+/**
+ * Compute the size of the message for a request.
+ *
+ * @param rr the request
+ * @return number of bytes needed to transmit @a rr
+ */
+static size_t
+get_request_size (const struct GNUNET_VPN_RedirectionRequest *rr)
+{
+  if (NULL != rr->batch)
+    return sizeof (struct RedirectToIpBatchRequestMessage) +
+      rr->batch_size * sizeof (struct RedirectToIpBatchEntry);
+  if (NULL == rr->addr)
+    return sizeof (struct RedirectToServiceRequestMessage);
+  if (AF_INET == rr->addr_af)
+    return sizeof (struct RedirectToIpRequestMessage) + sizeof (struct in_addr);
+  return sizeof (struct RedirectToIpRequestMessage) + sizeof (struct in6_addr);
+}
+
+
 /**
  * We're ready to transmit a request to the VPN service. Do it.
  *
@@ -256,10 +394,7 @@ transmit_request (void *cls,
 
   vh->th = NULL;
   /* find a pending request */
-  rr = vh->rr_head;
-  while ( (NULL != rr) &&
-	  (0 != rr->request_id) )
-    rr = rr->next;
+  rr = get_pending_request (vh);
   if (NULL == rr)
     return 0;
   if (0 == size)
@@ -273,7 +408,35 @@ transmit_request (void *cls,
     GNUNET_CLIENT_receive (vh->client,
 			   &receive_response, vh,
 			   GNUNET_TIME_UNIT_FOREVER_REL);
-  if (NULL == rr->addr)
+  if (NULL != rr->batch)
+  {
+    struct RedirectToIpBatchRequestMessage rb;
+    struct RedirectToIpBatchEntry *re;
+    unsigned int i;
+
+    ret = get_request_size (rr);
+    GNUNET_assert (ret <= size);
+    rb.header.size = htons ((uint16_t) ret);
+    rb.header.type = htons (GNUNET_MESSAGE_TYPE_VPN_CLIENT_REDIRECT_TO_IP_BATCH);
+    rb.count = htonl (rr->batch_size);
+    rb.expiration_time = GNUNET_TIME_absolute_hton (rr->expiration_time);
+    rb.request_id = rr->request_id = ++vh->request_id_gen;
+    cbuf = buf;
+    memcpy (cbuf, &rb, sizeof (struct RedirectToIpBatchRequestMessage));
+    re = (struct RedirectToIpBatchEntry *) &cbuf[sizeof (struct RedirectToIpBatchRequestMessage)];
+    memset (re, 0, rr->batch_size * sizeof (struct RedirectToIpBatchEntry));
+    for (i=0;i<rr->batch_size;i++)
+    {
+      re[i].result_af = htonl (rr->batch[i].result_af);
+      re[i].addr_af = htonl (rr->batch[i].addr_af);
+      memcpy (&re[i].addr,
+	      &rr->batch[i].addr,
+	      (AF_INET == rr->batch[i].addr_af)
+	      ? sizeof (struct in_addr)
+	      : sizeof (struct in6_addr));
+    }
+  }
+  else if (NULL == rr->addr)
   {
     ret = sizeof (struct RedirectToServiceRequestMessage);
     GNUNET_assert (ret <= size);
@@ -316,12 +479,10 @@ transmit_request (void *cls,
     memcpy (&cbuf[sizeof (struct RedirectToIpRequestMessage)], rr->addr, alen);
   }
   /* test if there are more pending requests */
-  while ( (NULL != rr) &&
-	  (0 != rr->request_id) )
-    rr = rr->next;
+  rr = get_pending_request (vh);
   if (NULL != rr)
     vh->th = GNUNET_CLIENT_notify_transmit_ready (vh->client,
-						  sizeof (struct RedirectToServiceRequestMessage),
+						  get_request_size (rr),
 						  GNUNET_TIME_UNIT_FOREVER_REL,
 						  GNUNET_NO,
 						  &transmit_request,
@@ -347,7 +508,7 @@ queue_request (struct GNUNET_VPN_RedirectionRequest *rr)
   if ( (NULL == vh->th) &&
        (NULL != vh->client) )
     vh->th = GNUNET_CLIENT_notify_transmit_ready (vh->client,
-						  sizeof (struct RedirectToServiceRequestMessage),
+						  get_request_size (get_pending_request (vh)),
 						  GNUNET_TIME_UNIT_FOREVER_REL,
 						  GNUNET_NO,
 						  &transmit_request,
@@ -373,7 +534,7 @@ connect_task (void *cls,
   GNUNET_assert (NULL == vh->th);
   if (NULL != vh->rr_head)
     vh->th = GNUNET_CLIENT_notify_transmit_ready (vh->client,
-						  sizeof (struct RedirectToServiceRequestMessage),
+						  get_request_size (vh->rr_head),
 						  GNUNET_TIME_UNIT_FOREVER_REL,
 						  GNUNET_NO,
 						  &transmit_request,
@@ -536,6 +697,65 @@ GNUNET_VPN_redirect_to_ip (struct GNUNET_VPN_Handle *vh,
 }
 
 
+/**
+ * Tell the VPN that forwarding to several Internet addresses via
+ * some exit node is requested, as with #GNUNET_VPN_redirect_to_ip(),
+ * but using a single round trip to the VPN service for all of them.
+ *
+ * @param vh VPN handle
+ * @param count number of entries in @a destinations, at most
+ *        #GNUNET_VPN_MAX_BATCH_SIZE
+ * @param destinations destination IP addresses on the Internet
+ * @param expiration_time at what time should the redirections expire?
+ *        (this should not impact connections that are active at that time)
+ * @param cb function to call with the IPs
+ * @param cb_cls closure for @a cb
+ * @return handle to cancel the request (means the callback won't be
+ *         invoked anymore; the mappings may or may not be established
+ *         anyway), NULL if the request was malformed
+ */
+struct GNUNET_VPN_RedirectionRequest *
+GNUNET_VPN_redirect_to_ip_batch (struct GNUNET_VPN_Handle *vh,
+				 unsigned int count,
+				 const struct GNUNET_VPN_IpDestination *destinations,
+				 struct GNUNET_TIME_Absolute expiration_time,
+				 GNUNET_VPN_BatchAllocationCallback cb,
+				 void *cb_cls)
+{
+  struct GNUNET_VPN_RedirectionRequest *rr;
+  unsigned int i;
+
+  if ( (0 == count) ||
+       (count > GNUNET_VPN_MAX_BATCH_SIZE) )
+  {
+    GNUNET_break (0);
+    return NULL;
+  }
+  for (i=0;i<count;i++)
+  {
+    if ( (AF_INET != destinations[i].addr_af) &&
+	 (AF_INET6 != destinations[i].addr_af) )
+    {
+      GNUNET_break (0);
+      return NULL;
+    }
+  }
+  rr = GNUNET_malloc (sizeof (struct GNUNET_VPN_RedirectionRequest) +
+		      count * sizeof (struct GNUNET_VPN_IpDestination));
+  rr->vh = vh;
+  rr->batch = (const struct GNUNET_VPN_IpDestination *) &rr[1];
+  rr->batch_size = count;
+  rr->batch_cb = cb;
+  rr->cb_cls = cb_cls;
+  rr->expiration_time = expiration_time;
+  memcpy (&rr[1],
+	  destinations,
+	  count * sizeof (struct GNUNET_VPN_IpDestination));
+  queue_request (rr);
+  return rr;
+}
+
+
 /**
  * Connect to the VPN service
  *